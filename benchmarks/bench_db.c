@@ -0,0 +1,805 @@
+/**
+ * Database Workload Benchmarks
+ *
+ * Builds a dataset the size of a real installation (recordings of N cameras
+ * over a number of days, detections at a given density, and events) and
+ * times the query paths of the web interface and the retention job on it:
+ * each query alone, then all of them from concurrent readers while writers
+ * store detections and recordings as live streams do. Results are printed
+ * as JSON (or CSV), so schema, index and pooling changes can be compared on
+ * the same data.
+ *
+ * Building 90 days of data takes minutes. The database file is kept, and
+ * --reuse runs the benchmarks on it again; retention removes the oldest
+ * --retention-days days, so each run on a reused file has that much less
+ * history.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "core/config.h"
+#include "core/logger.h"
+#include "database/db_core.h"
+#include "database/db_recordings.h"
+#include "database/db_detections.h"
+#include "database/db_events.h"
+#include "video/detection_result.h"
+#include "web/api_handlers_timeline.h"
+
+#define DEFAULT_DB_PATH "/tmp/lightnvr_bench.db"
+#define SECONDS_PER_DAY 86400
+#define MAX_THREADS 64
+
+// Recordings per add_recording_metadata_batch() call while generating
+#define GENERATE_BATCH 1024
+
+// Sizes the web interface asks for: a page of the recordings list, the
+// segments of /api/timeline/segments and a page of events
+#define PAGE_SIZE 20
+#define TIMELINE_SEGMENTS 1000
+#define EVENTS_PAGE 100
+
+// Bitrate of the generated recordings, for their sizes
+#define RECORDING_BYTES_PER_SECOND (2000000 / 8)
+
+// A writer adds and finishes a recording every this many detection stores
+#define RECORDING_EVERY 50
+
+typedef struct {
+    double *ms;             // Latency of each call
+    int count;
+    int capacity;
+    long rows;              // Rows returned or affected, over all calls
+} samples_t;
+
+typedef struct {
+    pthread_t thread;
+    int index;
+    uint32_t rng;
+    timeline_segment_t *segments;
+    event_info_t *events;
+    samples_t *samples;     // One per query or write operation
+} worker_t;
+
+typedef int (*query_fn_t)(worker_t *w);
+
+typedef struct {
+    const char *name;
+    query_fn_t fn;
+} query_t;
+
+// Write operations of the concurrent phase, after the queries in worker_t.samples
+enum {
+    WRITE_STORE_DETECTIONS,
+    WRITE_RECORDING_ADD,
+    WRITE_RECORDING_UPDATE,
+    WRITE_OP_COUNT
+};
+
+static const char *write_ops[WRITE_OP_COUNT] = {"store_detections", "recording_add", "recording_update"};
+
+static const char *labels[] = {"person", "car", "truck", "bicycle", "dog", "cat"};
+
+static const char *db_path = DEFAULT_DB_PATH;
+static int cameras = 8;
+static int days = 90;
+static int segment_seconds = 60;
+static int detections_per_hour = 30;
+static int events_per_day = 20;
+static int readers = 4;
+static int writers = 2;
+static double duration = 3.0;
+static double write_rate = 10.0;
+static int retention_days = 1;
+static bool reuse = false;
+static bool csv = false;
+
+// Range of the dataset, read back from the database when it is reused
+static time_t data_start;
+static time_t data_end;
+static int total_recordings;
+
+static double deadline;
+static int result_count = 0;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Deterministic per thread, so runs query the same cameras and days
+static uint32_t next_random(uint32_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+static int random_below(uint32_t *state, int n) {
+    return n > 0 ? (int)(next_random(state) % (uint32_t)n) : 0;
+}
+
+static float random_unit(uint32_t *state) {
+    return (float)(next_random(state) & 0xffff) / 65536.0f;
+}
+
+static void camera_name(int index, char *name, size_t size) {
+    snprintf(name, size, "bench-cam-%02d", index);
+}
+
+static void random_camera(worker_t *w, char *name, size_t size) {
+    camera_name(random_below(&w->rng, cameras), name, size);
+}
+
+// Start of a random day of the dataset
+static time_t random_day(worker_t *w) {
+    int span = (int)((data_end - data_start) / SECONDS_PER_DAY);
+    return data_start + (time_t)random_below(&w->rng, span > 0 ? span : 1) * SECONDS_PER_DAY;
+}
+
+static void random_detections(uint32_t *rng, detection_result_t *result, int *next_track) {
+    result->count = 1 + random_below(rng, 3);
+    for (int i = 0; i < result->count; i++) {
+        detection_t *d = &result->detections[i];
+        snprintf(d->label, sizeof(d->label), "%s", labels[random_below(rng, sizeof(labels) / sizeof(labels[0]))]);
+        d->confidence = 0.5f + random_unit(rng) * 0.49f;
+        d->width = 0.05f + random_unit(rng) * 0.3f;
+        d->height = 0.05f + random_unit(rng) * 0.5f;
+        d->x = random_unit(rng) * (1.0f - d->width);
+        d->y = random_unit(rng) * (1.0f - d->height);
+        d->track_id = (*next_track)++;
+    }
+}
+
+static void add_sample(samples_t *s, double ms, int rows) {
+    if (s->count == s->capacity) {
+        int capacity = s->capacity ? s->capacity * 2 : 1024;
+        double *ms_new = realloc(s->ms, capacity * sizeof(double));
+        if (!ms_new) {
+            return;
+        }
+        s->ms = ms_new;
+        s->capacity = capacity;
+    }
+    s->ms[s->count++] = ms;
+    if (rows > 0) {
+        s->rows += rows;
+    }
+}
+
+static void merge_samples(samples_t *into, const samples_t *from) {
+    for (int i = 0; i < from->count; i++) {
+        add_sample(into, from->ms[i], 0);
+    }
+    into->rows += from->rows;
+}
+
+static double percentile(const samples_t *s, double p) {
+    int i = (int)(p * (s->count - 1) + 0.5);
+    return s->ms[i];
+}
+
+/**
+ * Print one result
+ *
+ * @param calls Calls made; for samples with latencies, their count
+ * @param s Latencies, or NULL for throughput only
+ */
+static void print_result(const char *phase, const char *op, int threads, long calls, long rows,
+                         samples_t *s, double seconds) {
+    double p50 = 0, p95 = 0, p99 = 0, max = 0;
+    bool latency = s && s->count > 0;
+    if (latency) {
+        qsort(s->ms, s->count, sizeof(double), compare_doubles);
+        p50 = percentile(s, 0.50);
+        p95 = percentile(s, 0.95);
+        p99 = percentile(s, 0.99);
+        max = s->ms[s->count - 1];
+    }
+    double per_second = seconds > 0 ? calls / seconds : 0;
+    double rows_per_call = calls > 0 ? (double)rows / calls : 0;
+
+    if (csv) {
+        if (result_count == 0) {
+            printf("phase,op,threads,calls,seconds,calls_per_s,rows_per_call,ms_p50,ms_p95,ms_p99,ms_max\n");
+        }
+        printf("%s,%s,%d,%ld,%.3f,%.1f,%.1f", phase, op, threads, calls, seconds, per_second, rows_per_call);
+        if (latency) {
+            printf(",%.3f,%.3f,%.3f,%.3f\n", p50, p95, p99, max);
+        } else {
+            printf(",,,,\n");
+        }
+    } else {
+        printf("%s    {\"phase\": \"%s\", \"op\": \"%s\", \"threads\": %d, \"calls\": %ld, \"seconds\": %.3f, "
+               "\"calls_per_s\": %.1f, \"rows_per_call\": %.1f",
+               result_count ? ",\n" : "", phase, op, threads, calls, seconds, per_second, rows_per_call);
+        if (latency) {
+            printf(", \"ms_p50\": %.3f, \"ms_p95\": %.3f, \"ms_p99\": %.3f, \"ms_max\": %.3f}", p50, p95, p99, max);
+        } else {
+            printf(", \"ms_p50\": null, \"ms_p95\": null, \"ms_p99\": null, \"ms_max\": null}");
+        }
+    }
+    fflush(stdout);
+    result_count++;
+}
+
+// Queries of the web interface
+
+// First page of the recordings list, all cameras, newest first
+static int query_recordings_first_page(worker_t *w) {
+    recording_metadata_t page[PAGE_SIZE];
+    (void)w;
+    return get_recording_metadata_paginated(0, 0, NULL, 0, "start_time", "desc", page, PAGE_SIZE, 0);
+}
+
+// A page anywhere in the list, as when jumping to the last pages
+static int query_recordings_deep_page(worker_t *w) {
+    recording_metadata_t page[PAGE_SIZE];
+    int offset = random_below(&w->rng, total_recordings > PAGE_SIZE ? total_recordings - PAGE_SIZE : 1);
+    return get_recording_metadata_paginated(0, 0, NULL, 0, "start_time", "desc", page, PAGE_SIZE, offset);
+}
+
+// First page of one camera's recordings of one day
+static int query_recordings_camera_day(worker_t *w) {
+    recording_metadata_t page[PAGE_SIZE];
+    char name[64];
+    random_camera(w, name, sizeof(name));
+    time_t day = random_day(w);
+    return get_recording_metadata_paginated(day, day + SECONDS_PER_DAY, name, 0, "start_time", "desc",
+                                            page, PAGE_SIZE, 0);
+}
+
+// Same, only recordings with detections
+static int query_recordings_with_detections(worker_t *w) {
+    recording_metadata_t page[PAGE_SIZE];
+    char name[64];
+    random_camera(w, name, sizeof(name));
+    time_t day = random_day(w);
+    return get_recording_metadata_paginated(day, day + SECONDS_PER_DAY, name, 1, "start_time", "desc",
+                                            page, PAGE_SIZE, 0);
+}
+
+// Total the recordings list shows for one camera
+static int query_recordings_count(worker_t *w) {
+    char name[64];
+    random_camera(w, name, sizeof(name));
+    return get_recording_count(0, 0, name, 0) >= 0 ? 1 : -1;
+}
+
+// Detections of one camera in one hour, as drawn over a recording
+static int query_detections_hour(worker_t *w) {
+    detection_result_t result;
+    char name[64];
+    random_camera(w, name, sizeof(name));
+    time_t start = random_day(w) + (time_t)random_below(&w->rng, 24) * 3600;
+    return get_detections_from_db_time_range(name, &result, 0, start, start + 3600);
+}
+
+// Timeline of one camera and day
+static int query_timeline_day(worker_t *w) {
+    char name[64];
+    random_camera(w, name, sizeof(name));
+    time_t day = random_day(w);
+    return get_timeline_segments(name, day, day + SECONDS_PER_DAY, w->segments, TIMELINE_SEGMENTS);
+}
+
+// Events of one day, all cameras
+static int query_events_day(worker_t *w) {
+    time_t day = random_day(w);
+    return get_events(day, day + SECONDS_PER_DAY, -1, NULL, w->events, EVENTS_PAGE);
+}
+
+static const query_t queries[] = {
+    {"recordings_first_page", query_recordings_first_page},
+    {"recordings_deep_page", query_recordings_deep_page},
+    {"recordings_camera_day", query_recordings_camera_day},
+    {"recordings_with_detections", query_recordings_with_detections},
+    {"recordings_count", query_recordings_count},
+    {"detections_hour", query_detections_hour},
+    {"timeline_day", query_timeline_day},
+    {"events_day", query_events_day},
+};
+
+#define QUERY_COUNT ((int)(sizeof(queries) / sizeof(queries[0])))
+
+static int init_worker(worker_t *w, int index) {
+    memset(w, 0, sizeof(*w));
+    w->index = index;
+    w->rng = 2463534242u + (uint32_t)index * 7919u;
+    w->segments = calloc(TIMELINE_SEGMENTS, sizeof(timeline_segment_t));
+    w->events = calloc(EVENTS_PAGE, sizeof(event_info_t));
+    w->samples = calloc(QUERY_COUNT + WRITE_OP_COUNT, sizeof(samples_t));
+    return w->segments && w->events && w->samples ? 0 : -1;
+}
+
+static void free_worker(worker_t *w) {
+    if (w->samples) {
+        for (int i = 0; i < QUERY_COUNT + WRITE_OP_COUNT; i++) {
+            free(w->samples[i].ms);
+        }
+    }
+    free(w->samples);
+    free(w->segments);
+    free(w->events);
+}
+
+static int run_query(worker_t *w, int q) {
+    double start = now_seconds();
+    int rows = queries[q].fn(w);
+    if (rows < 0) {
+        return -1;
+    }
+    add_sample(&w->samples[q], (now_seconds() - start) * 1000.0, rows);
+    return 0;
+}
+
+// Dataset
+
+static long generate_recordings(void) {
+    recording_metadata_t *batch = calloc(GENERATE_BATCH, sizeof(recording_metadata_t));
+    if (!batch) {
+        return -1;
+    }
+
+    uint32_t rng = 1;
+    long rows = 0;
+    int count = 0;
+    for (time_t t = data_start; t < data_end; t += segment_seconds) {
+        for (int c = 0; c < cameras; c++) {
+            recording_metadata_t *r = &batch[count++];
+            camera_name(c, r->stream_name, sizeof(r->stream_name));
+            snprintf(r->file_path, sizeof(r->file_path), "/bench/recordings/%s/recording_%ld.mp4",
+                     r->stream_name, (long)t);
+            r->start_time = t;
+            r->end_time = t + segment_seconds;
+            r->size_bytes = (uint64_t)segment_seconds * RECORDING_BYTES_PER_SECOND * (80 + random_below(&rng, 41)) / 100;
+            r->width = 1920;
+            r->height = 1080;
+            r->fps = 15;
+            snprintf(r->codec, sizeof(r->codec), "h264");
+            r->is_complete = true;
+
+            if (count == GENERATE_BATCH) {
+                if (add_recording_metadata_batch(batch, count) != count) {
+                    free(batch);
+                    return -1;
+                }
+                rows += count;
+                count = 0;
+            }
+        }
+    }
+    if (count > 0 && add_recording_metadata_batch(batch, count) != count) {
+        free(batch);
+        return -1;
+    }
+    free(batch);
+    return rows + count;
+}
+
+// Stored directly, one transaction per frame, since the writer thread would drop a backlog this size
+static long generate_detections(void) {
+    uint32_t rng = 2;
+    int next_track = 1;
+    long rows = 0;
+    char name[64];
+    detection_result_t result;
+
+    for (time_t hour = data_start; hour < data_end; hour += 3600) {
+        for (int c = 0; c < cameras; c++) {
+            camera_name(c, name, sizeof(name));
+            for (int i = 0; i < detections_per_hour; i++) {
+                random_detections(&rng, &result, &next_track);
+                time_t t = hour + (time_t)i * 3600 / detections_per_hour + random_below(&rng, 3600 / detections_per_hour);
+                if (store_detections_in_db(name, &result, t) != 0) {
+                    return -1;
+                }
+                rows += result.count;
+            }
+        }
+    }
+    return rows;
+}
+
+static long generate_events(void) {
+    static const event_type_t types[] = {
+        EVENT_STREAM_CONNECTED, EVENT_STREAM_DISCONNECTED, EVENT_RECORDING_START, EVENT_RECORDING_STOP,
+    };
+    uint32_t rng = 3;
+    long rows = 0;
+    char name[64];
+
+    for (time_t day = data_start; day < data_end; day += SECONDS_PER_DAY) {
+        for (int c = 0; c < cameras; c++) {
+            camera_name(c, name, sizeof(name));
+            for (int i = 0; i < events_per_day; i++) {
+                event_type_t type = types[random_below(&rng, sizeof(types) / sizeof(types[0]))];
+                time_t t = day + random_below(&rng, SECONDS_PER_DAY);
+                if (add_event_at(type, t, name, "Benchmark event", NULL) == 0) {
+                    return -1;
+                }
+                rows++;
+            }
+        }
+    }
+    return rows;
+}
+
+/**
+ * Build the dataset, timing each table
+ *
+ * @return 0 on success, -1 on failure
+ */
+static int generate_dataset(long *rows, double *seconds) {
+    // Whole days up to now, so retention cutoffs fall on day boundaries
+    data_end = time(NULL) / SECONDS_PER_DAY * SECONDS_PER_DAY;
+    data_start = data_end - (time_t)days * SECONDS_PER_DAY;
+    fprintf(stderr, "Generating %d days of %d cameras in %s\n", days, cameras, db_path);
+
+    double start = now_seconds();
+    rows[0] = generate_recordings();
+    seconds[0] = now_seconds() - start;
+
+    start = now_seconds();
+    rows[1] = rows[0] < 0 ? -1 : generate_detections();
+    seconds[1] = now_seconds() - start;
+
+    start = now_seconds();
+    rows[2] = rows[1] < 0 ? -1 : generate_events();
+    seconds[2] = now_seconds() - start;
+
+    if (rows[2] < 0) {
+        fprintf(stderr, "Failed to generate the dataset\n");
+        return -1;
+    }
+    checkpoint_database();
+    return 0;
+}
+
+// Read back the range of a dataset built by an earlier run
+static int find_dataset(void) {
+    recording_metadata_t first, last;
+    if (get_recording_metadata_paginated(0, 0, NULL, 0, "start_time", "asc", &first, 1, 0) != 1 ||
+        get_recording_metadata_paginated(0, 0, NULL, 0, "start_time", "desc", &last, 1, 0) != 1) {
+        return -1;
+    }
+    data_start = first.start_time;
+    data_end = last.end_time;
+    return 0;
+}
+
+// Phases
+
+static void run_single_queries(void) {
+    worker_t w;
+    if (init_worker(&w, 0) != 0) {
+        free_worker(&w);
+        return;
+    }
+
+    for (int q = 0; q < QUERY_COUNT; q++) {
+        double start = now_seconds();
+        double end = start + duration;
+        while (now_seconds() < end) {
+            if (run_query(&w, q) != 0) {
+                fprintf(stderr, "Query %s failed\n", queries[q].name);
+                break;
+            }
+        }
+        samples_t *s = &w.samples[q];
+        print_result("single", queries[q].name, 1, s->count, s->rows, s, now_seconds() - start);
+    }
+    free_worker(&w);
+}
+
+static void *reader_thread(void *arg) {
+    worker_t *w = arg;
+    while (now_seconds() < deadline) {
+        run_query(w, random_below(&w->rng, QUERY_COUNT));
+    }
+    return NULL;
+}
+
+/**
+ * Store detections like the detection thread of a camera, and add and
+ * finish a recording every RECORDING_EVERY frames, like the MP4 writer
+ * Frames come at write_rate per second, or as fast as possible with 0.
+ */
+static void *writer_thread(void *arg) {
+    worker_t *w = arg;
+    char name[64];
+    int next_track = 1000000 * (w->index + 1);
+    detection_result_t result;
+    recording_metadata_t recording;
+
+    camera_name(w->index % cameras, name, sizeof(name));
+    double first = now_seconds();
+    for (long n = 0; now_seconds() < deadline; n++) {
+        if (write_rate > 0) {
+            double wait = first + n / write_rate - now_seconds();
+            if (wait > 0) {
+                usleep((useconds_t)(wait * 1e6));
+            }
+        }
+
+        random_detections(&w->rng, &result, &next_track);
+        double start = now_seconds();
+        if (store_detections_in_db(name, &result, time(NULL)) == 0) {
+            add_sample(&w->samples[QUERY_COUNT + WRITE_STORE_DETECTIONS], (now_seconds() - start) * 1000.0,
+                       result.count);
+        }
+
+        if (n % RECORDING_EVERY != 0) {
+            continue;
+        }
+        memset(&recording, 0, sizeof(recording));
+        snprintf(recording.stream_name, sizeof(recording.stream_name), "%s", name);
+        snprintf(recording.file_path, sizeof(recording.file_path), "/bench/recordings/%s/live_%d_%ld.mp4",
+                 name, w->index, n);
+        recording.start_time = time(NULL);
+        recording.width = 1920;
+        recording.height = 1080;
+        recording.fps = 15;
+        snprintf(recording.codec, sizeof(recording.codec), "h264");
+
+        start = now_seconds();
+        uint64_t id = add_recording_metadata(&recording);
+        if (id == 0) {
+            continue;
+        }
+        double added = now_seconds();
+        add_sample(&w->samples[QUERY_COUNT + WRITE_RECORDING_ADD], (added - start) * 1000.0, 1);
+        if (update_recording_metadata(id, recording.start_time + segment_seconds,
+                                      (uint64_t)segment_seconds * RECORDING_BYTES_PER_SECOND, true) == 0) {
+            add_sample(&w->samples[QUERY_COUNT + WRITE_RECORDING_UPDATE], (now_seconds() - added) * 1000.0, 1);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Run readers and writers together for --duration seconds
+ * The detection writer thread runs for the phase, as in the server.
+ */
+static void run_phase(const char *phase, int reader_count, int writer_count) {
+    int threads = reader_count + writer_count;
+    worker_t *workers = calloc(threads, sizeof(worker_t));
+    if (!workers) {
+        return;
+    }
+
+    uint64_t written_before, dropped_before, written_after, dropped_after;
+    init_detection_writer();
+    get_detection_writer_stats(&written_before, &dropped_before);
+
+    double start = now_seconds();
+    deadline = start + duration;
+    int started = 0;
+    for (int i = 0; i < threads; i++, started++) {
+        if (init_worker(&workers[i], i) != 0 ||
+            pthread_create(&workers[i].thread, NULL, i < reader_count ? reader_thread : writer_thread,
+                           &workers[i]) != 0) {
+            fprintf(stderr, "Failed to start benchmark thread %d\n", i);
+            break;
+        }
+    }
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+    double seconds = now_seconds() - start;
+    get_detection_writer_stats(&written_after, &dropped_after);
+
+    // Whatever is still queued is written before the next phase
+    shutdown_detection_writer();
+
+    samples_t merged;
+    for (int op = 0; op < QUERY_COUNT + WRITE_OP_COUNT; op++) {
+        bool query = op < QUERY_COUNT;
+        if ((query ? reader_count : writer_count) == 0) {
+            continue;
+        }
+        memset(&merged, 0, sizeof(merged));
+        for (int i = query ? 0 : reader_count; i < (query ? reader_count : threads) && i < started; i++) {
+            merge_samples(&merged, &workers[i].samples[op]);
+        }
+        print_result(phase, query ? queries[op].name : write_ops[op - QUERY_COUNT],
+                     query ? reader_count : writer_count, merged.count, merged.rows, &merged, seconds);
+        free(merged.ms);
+    }
+
+    // Rows the writer thread committed while the phase ran, and rows it had no room for
+    if (writer_count > 0) {
+        long written = (long)(written_after - written_before);
+        long dropped = (long)(dropped_after - dropped_before);
+        print_result(phase, "detections_written", 1, written, written, NULL, seconds);
+        print_result(phase, "detections_dropped", writer_count, dropped, dropped, NULL, seconds);
+    }
+
+    for (int i = 0; i < threads; i++) {
+        free_worker(&workers[i]);
+    }
+    free(workers);
+}
+
+// Delete the oldest days, one day per call, like the daily retention job
+static void run_retention(void) {
+    samples_t s[3];
+    static const char *ops[3] = {"delete_recordings", "delete_detections", "delete_events"};
+    memset(s, 0, sizeof(s));
+
+    double start = now_seconds();
+    for (int d = 1; d <= retention_days && data_start + (time_t)d * SECONDS_PER_DAY < data_end; d++) {
+        uint64_t max_age = (uint64_t)(time(NULL) - (data_start + (time_t)d * SECONDS_PER_DAY));
+        for (int op = 0; op < 3; op++) {
+            double t = now_seconds();
+            int rows = op == 0 ? delete_old_recording_metadata(max_age) :
+                       op == 1 ? delete_old_detections(max_age) : delete_old_events(max_age);
+            add_sample(&s[op], (now_seconds() - t) * 1000.0, rows);
+        }
+    }
+    double seconds = now_seconds() - start;
+
+    for (int op = 0; op < 3; op++) {
+        print_result("retention", ops[op], 1, s[op].count, s[op].rows, &s[op], seconds);
+        free(s[op].ms);
+    }
+}
+
+static void usage(const char *program) {
+    fprintf(stderr, "Usage: %s [options]\n"
+                    "  -d, --db PATH              Database file (default " DEFAULT_DB_PATH ")\n"
+                    "      --reuse                Run on the dataset already in the file\n"
+                    "  -n, --cameras N            Cameras (default 8)\n"
+                    "      --days N               Days of history (default 90)\n"
+                    "      --segment SECONDS      Recording length (default 60)\n"
+                    "      --detections N         Frames with detections per camera and hour (default 30)\n"
+                    "      --events N             Events per camera and day (default 20)\n"
+                    "  -r, --readers N            Reader threads of the concurrent phase (default 4)\n"
+                    "  -w, --writers N            Writer threads of the concurrent phase (default 2)\n"
+                    "      --write-rate N         Frames with detections per writer and second (default 10)\n"
+                    "  -t, --duration SECONDS     Time per measurement (default 3)\n"
+                    "      --retention-days N     Oldest days to delete, 0 to keep them (default 1)\n"
+                    "      --compact              Store detections as compact minute blocks\n"
+                    "      --partition            Store detections and events in day partitions\n"
+                    "  -c, --csv                  Print CSV instead of JSON\n",
+            program);
+}
+
+int main(int argc, char **argv) {
+    load_default_config(&g_config);
+    g_config.db_compact_detections = false;
+    g_config.db_partition_by_day = false;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if ((strcmp(arg, "-d") == 0 || strcmp(arg, "--db") == 0) && has_value) {
+            db_path = argv[++i];
+        } else if (strcmp(arg, "--reuse") == 0) {
+            reuse = true;
+        } else if ((strcmp(arg, "-n") == 0 || strcmp(arg, "--cameras") == 0) && has_value) {
+            cameras = atoi(argv[++i]);
+        } else if (strcmp(arg, "--days") == 0 && has_value) {
+            days = atoi(argv[++i]);
+        } else if (strcmp(arg, "--segment") == 0 && has_value) {
+            segment_seconds = atoi(argv[++i]);
+        } else if (strcmp(arg, "--detections") == 0 && has_value) {
+            detections_per_hour = atoi(argv[++i]);
+        } else if (strcmp(arg, "--events") == 0 && has_value) {
+            events_per_day = atoi(argv[++i]);
+        } else if ((strcmp(arg, "-r") == 0 || strcmp(arg, "--readers") == 0) && has_value) {
+            readers = atoi(argv[++i]);
+        } else if ((strcmp(arg, "-w") == 0 || strcmp(arg, "--writers") == 0) && has_value) {
+            writers = atoi(argv[++i]);
+        } else if (strcmp(arg, "--write-rate") == 0 && has_value) {
+            write_rate = atof(argv[++i]);
+        } else if ((strcmp(arg, "-t") == 0 || strcmp(arg, "--duration") == 0) && has_value) {
+            duration = atof(argv[++i]);
+        } else if (strcmp(arg, "--retention-days") == 0 && has_value) {
+            retention_days = atoi(argv[++i]);
+        } else if (strcmp(arg, "--compact") == 0) {
+            g_config.db_compact_detections = true;
+        } else if (strcmp(arg, "--partition") == 0) {
+            g_config.db_partition_by_day = true;
+        } else if (strcmp(arg, "-c") == 0 || strcmp(arg, "--csv") == 0) {
+            csv = true;
+        } else {
+            usage(argv[0]);
+            return strcmp(arg, "-h") == 0 || strcmp(arg, "--help") == 0 ? 0 : 1;
+        }
+    }
+    if (cameras < 1 || days < 1 || segment_seconds < 1 || detections_per_hour < 0 || detections_per_hour > 3600 ||
+        events_per_day < 0 || readers < 0 || writers < 0 || readers + writers > MAX_THREADS || duration <= 0 || write_rate <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    // Set first, so nothing but results reaches stdout
+    set_log_level(LOG_LEVEL_ERROR);
+    init_logger();
+
+    if (!reuse) {
+        unlink(db_path);
+        char wal[512];
+        snprintf(wal, sizeof(wal), "%s-wal", db_path);
+        unlink(wal);
+        snprintf(wal, sizeof(wal), "%s-shm", db_path);
+        unlink(wal);
+    }
+    if (init_database(db_path) != 0) {
+        fprintf(stderr, "Failed to open database %s\n", db_path);
+        shutdown_logger();
+        return 1;
+    }
+
+    // Generated rows are written directly, without the queue of the writer thread
+    shutdown_detection_writer();
+
+    double seconds[3] = {0, 0, 0};
+    long rows[3] = {0, 0, 0};
+    if (reuse && find_dataset() != 0) {
+        fprintf(stderr, "No dataset in %s, run without --reuse first\n", db_path);
+        shutdown_database();
+        shutdown_logger();
+        return 1;
+    }
+    if (!reuse && generate_dataset(rows, seconds) != 0) {
+        shutdown_database();
+        shutdown_logger();
+        return 1;
+    }
+    total_recordings = get_recording_count(0, 0, NULL, 0);
+
+    struct stat st;
+    long long db_bytes = stat(db_path, &st) == 0 ? (long long)st.st_size : 0;
+    if (!csv) {
+        printf("{\n  \"dataset\": {\"cameras\": %d, \"days\": %ld, \"segment_seconds\": %d, \"recordings\": %d, "
+               "\"detections_per_hour\": %d, \"events_per_day\": %d, \"compact_detections\": %s, "
+               "\"partition_by_day\": %s, \"db_bytes\": %lld},\n  \"results\": [\n",
+               cameras, (long)((data_end - data_start) / SECONDS_PER_DAY), segment_seconds, total_recordings,
+               detections_per_hour, events_per_day, g_config.db_compact_detections ? "true" : "false",
+               g_config.db_partition_by_day ? "true" : "false", db_bytes);
+    }
+
+    if (!reuse) {
+        static const char *generated[3] = {"recordings", "detections", "events"};
+        for (int i = 0; i < 3; i++) {
+            print_result("generate", generated[i], 1, rows[i], rows[i], NULL, seconds[i]);
+        }
+    }
+
+    run_single_queries();
+    // How fast the detection writer drains a single stream that never pauses,
+    // then the web interface under live writes
+    double paced = write_rate;
+    write_rate = 0;
+    run_phase("write", 0, 1);
+    write_rate = paced;
+    run_phase("concurrent", readers, writers);
+    if (retention_days > 0) {
+        run_retention();
+    }
+
+    if (!csv) {
+        printf("\n  ]\n}\n");
+    }
+
+    shutdown_database();
+    shutdown_logger();
+    return 0;
+}
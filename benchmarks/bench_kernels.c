@@ -0,0 +1,529 @@
+/**
+ * Video and Vision Kernel Benchmarks
+ *
+ * Times the motion detection pixel kernels and the SOD compute kernels at
+ * 360p, 720p, 1080p and 4K, once for every instruction set they are
+ * compiled for and the CPU supports, and prints the results as JSON (or
+ * CSV) for regression tracking.
+ *
+ * Each measurement is calibrated to run for about --min-time seconds, split
+ * in batches; the fastest and the median batch are reported per call. The
+ * first variant of a kernel is the one the CPU runs by default; a default
+ * clearly slower than another variant is reported on stderr.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/utsname.h>
+
+#include "core/logger.h"
+#include "video/motion_kernels.h"
+#include "video/motion_detection.h"
+#include "video/detection_result.h"
+#include "video/stream_registry.h"
+
+#ifdef SOD_ENABLED
+#include "sod/sod.h"
+#endif
+
+#define BENCH_BATCHES 5
+#define MAX_VARIANTS 8
+
+// A default variant taking this much longer than another one is reported
+#define SLOW_DEFAULT_RATIO 1.25
+#define MAX_DEFAULT_TIMES 64
+
+// Grid of calculate_grid_motion() with the default configuration
+#define BENCH_GRID_SIZE 8
+
+// Layer timed for gemm and im2col: 3x3 convolution, 16 to 32 channels, on a
+// feature map of 1/16 of the frame, like an early layer of a tiny YOLO
+#define BENCH_CONV_STRIDE 16
+#define BENCH_CONV_IN 16
+#define BENCH_CONV_OUT 32
+#define BENCH_CONV_KSIZE 3
+
+// Network input sod_resize_image() scales frames to
+#define BENCH_NET_SIZE 416
+
+typedef struct {
+    const char *name;
+    int width;
+    int height;
+} resolution_t;
+
+static const resolution_t resolutions[] = {
+    {"360p", 640, 360},
+    {"720p", 1280, 720},
+    {"1080p", 1920, 1080},
+    {"4k", 3840, 2160},
+};
+
+typedef void (*bench_fn_t)(void *arg);
+
+static double min_time = 1.0;
+static const char *filter = NULL;
+static const char *only_resolution = NULL;
+static bool csv = false;
+static int result_count = 0;
+
+// Fastest time per call of the default variant of each kernel and resolution
+typedef struct {
+    const char *kernel;
+    const char *resolution;
+    const char *variant;
+    double best;
+} default_time_t;
+
+static default_time_t default_times[MAX_DEFAULT_TIMES];
+static int default_count = 0;
+static int slow_defaults = 0;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Deterministic inputs, so runs on different machines time the same data
+static uint32_t bench_random(void) {
+    static uint32_t state = 2463534242u;
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+static void fill_random(uint8_t *data, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        data[i] = (uint8_t)bench_random();
+    }
+}
+
+static bool selected(const char *kernel, const resolution_t *res) {
+    if (filter && !strstr(kernel, filter)) {
+        return false;
+    }
+    return !only_resolution || strcmp(only_resolution, res->name) == 0;
+}
+
+/**
+ * Remember the time of a default variant, or compare another variant with it
+ * The default is what every machine with that instruction set runs, so
+ * losing to a narrower variant is a regression worth a warning.
+ */
+static void check_default(const char *kernel, const char *variant, const resolution_t *res,
+                          double best, bool is_default) {
+    if (is_default) {
+        if (default_count < MAX_DEFAULT_TIMES) {
+            default_times[default_count++] = (default_time_t){ kernel, res->name, variant, best };
+        }
+        return;
+    }
+    for (int i = 0; i < default_count; i++) {
+        const default_time_t *d = &default_times[i];
+        if (strcmp(d->kernel, kernel) == 0 && strcmp(d->resolution, res->name) == 0) {
+            if (d->best > best * SLOW_DEFAULT_RATIO) {
+                fprintf(stderr, "Warning: %s at %s: default %s takes %.1fx as long as %s\n",
+                        kernel, res->name, d->variant, d->best / best, variant);
+                slow_defaults++;
+            }
+            return;
+        }
+    }
+}
+
+/**
+ * Time fn and print one result
+ *
+ * @param is_default Whether variant is the one picked by default, compared with the others
+ * @param work Units of work per call (pixels, elements, boxes or floating point operations)
+ * @param unit Name of the throughput figure; "gflops" is in billions, the others in millions
+ */
+static void run_bench(const char *kernel, const char *variant, bool is_default, const resolution_t *res,
+                      bench_fn_t fn, void *arg, double work, const char *unit) {
+    // Warm up caches and lazily initialized state, and size the batches
+    double start = now_seconds();
+    fn(arg);
+    double once = now_seconds() - start;
+
+    double batch_time = min_time / BENCH_BATCHES;
+    long iterations = once > 0 ? (long)(batch_time / once) : 1000000;
+    if (iterations < 1) {
+        iterations = 1;
+    }
+
+    double per_call[BENCH_BATCHES];
+    for (int b = 0; b < BENCH_BATCHES; b++) {
+        start = now_seconds();
+        for (long i = 0; i < iterations; i++) {
+            fn(arg);
+        }
+        per_call[b] = (now_seconds() - start) / (double)iterations;
+    }
+    qsort(per_call, BENCH_BATCHES, sizeof(double), compare_doubles);
+
+    double best = per_call[0];
+    double median = per_call[BENCH_BATCHES / 2];
+    double throughput = strcmp(unit, "gflops") == 0 ? work / best / 1e9 : work / best / 1e6;
+
+    if (csv) {
+        if (result_count == 0) {
+            printf("kernel,variant,resolution,width,height,iterations,ns_min,ns_median,throughput,unit\n");
+        }
+        printf("%s,%s,%s,%d,%d,%ld,%.0f,%.0f,%.3f,%s\n", kernel, variant, res->name, res->width, res->height,
+               iterations * BENCH_BATCHES, best * 1e9, median * 1e9, throughput, unit);
+    } else {
+        printf("%s    {\"kernel\": \"%s\", \"variant\": \"%s\", \"resolution\": \"%s\", \"width\": %d, "
+               "\"height\": %d, \"iterations\": %ld, \"ns_min\": %.0f, \"ns_median\": %.0f, \"%s\": %.3f}",
+               result_count > 0 ? ",\n" : "", kernel, variant, res->name, res->width, res->height,
+               iterations * BENCH_BATCHES, best * 1e9, median * 1e9, unit, throughput);
+    }
+    fflush(stdout);
+    result_count++;
+
+    check_default(kernel, variant, res, best, is_default);
+}
+
+/* Motion detection kernels */
+
+typedef struct {
+    int width;
+    int height;
+    uint8_t *rgb;
+    uint8_t *gray;
+    uint8_t *prev;
+    uint8_t *background;
+    uint8_t *out;
+    uint8_t *temp;
+    uint16_t *sums;
+    const char *stream_name;
+    long frame;
+} motion_bench_t;
+
+static void bench_gray(void *arg) {
+    motion_bench_t *m = arg;
+    motion_rgb_to_gray(m->rgb, m->out, m->width * m->height);
+}
+
+static void bench_downscale(void *arg) {
+    motion_bench_t *m = arg;
+    motion_downscale_gray(m->gray, m->width, m->width, m->height, 2, m->out, m->width / 2, m->height / 2);
+}
+
+static void bench_blur(void *arg) {
+    motion_bench_t *m = arg;
+    // Both passes, as apply_box_blur() runs them, with the default radius
+    motion_box_blur_rows(m->gray, m->temp, m->sums, m->width, m->height, 1);
+    motion_box_blur_cols(m->temp, m->out, m->sums, m->width, m->height, 1);
+}
+
+static void bench_grid(void *arg) {
+    motion_bench_t *m = arg;
+    // The walk of calculate_grid_motion(): a band of cells at a time, every other row and pixel
+    int cell_width = m->width / BENCH_GRID_SIZE;
+    int cell_height = m->height / BENCH_GRID_SIZE;
+    uint32_t cell_diff[BENCH_GRID_SIZE];
+    for (int gy = 0; gy < BENCH_GRID_SIZE; gy++) {
+        memset(cell_diff, 0, sizeof(cell_diff));
+        for (int y = gy * cell_height; y < (gy + 1) * cell_height; y += 2) {
+            int row = y * m->width;
+            for (int gx = 0; gx < BENCH_GRID_SIZE; gx++) {
+                int idx = row + gx * cell_width;
+                uint32_t changed = 0;
+                motion_diff_sum(m->gray + idx, m->prev + idx, m->background + idx, cell_width, 2, 25,
+                                &cell_diff[gx], &changed);
+            }
+        }
+    }
+}
+
+static void bench_background(void *arg) {
+    motion_bench_t *m = arg;
+    motion_blend_background(m->background, m->gray, m->width * m->height, 5);
+}
+
+static void bench_motion_frame(void *arg) {
+    motion_bench_t *m = arg;
+    detection_result_t result;
+    // Alternate two frames so every call sees motion
+    const uint8_t *luma = (m->frame++ & 1) ? m->prev : m->gray;
+    detect_motion_luma(m->stream_name, luma, m->width, m->width, m->height, (time_t)m->frame, &result);
+}
+
+static void run_motion_benchmarks(void) {
+    const char *isas[MAX_VARIANTS];
+    int isa_count = motion_kernels_variants(isas, MAX_VARIANTS);
+
+    for (size_t r = 0; r < sizeof(resolutions) / sizeof(resolutions[0]); r++) {
+        const resolution_t *res = &resolutions[r];
+        size_t pixels = (size_t)res->width * res->height;
+
+        motion_bench_t m = {
+            .width = res->width,
+            .height = res->height,
+            .rgb = malloc(pixels * 3),
+            .gray = malloc(pixels),
+            .prev = malloc(pixels),
+            .background = malloc(pixels),
+            .out = malloc(pixels),
+            .temp = malloc(pixels),
+            .sums = malloc((res->width + 1) * sizeof(uint16_t)),
+            .stream_name = res->name,
+        };
+        if (!m.rgb || !m.gray || !m.prev || !m.background || !m.out || !m.temp || !m.sums) {
+            fprintf(stderr, "Out of memory for %s buffers\n", res->name);
+            exit(1);
+        }
+        fill_random(m.rgb, pixels * 3);
+        fill_random(m.gray, pixels);
+        fill_random(m.prev, pixels);
+        fill_random(m.background, pixels);
+
+        // One motion stream per resolution, downscaled by 2 and without cooldown
+        if (selected("motion_frame", res)) {
+            stream_registry_acquire(res->name);
+            configure_motion_detection(res->name, 0.5f, 0.01f, 0);
+            configure_motion_detection_optimizations(res->name, true, 2);
+            set_motion_detection_enabled(res->name, true);
+        }
+
+        for (int v = 0; v < isa_count; v++) {
+            motion_kernels_use(isas[v]);
+            if (selected("rgb_to_grayscale", res)) {
+                run_bench("rgb_to_grayscale", isas[v], v == 0, res, bench_gray, &m, (double)pixels, "mpix_per_s");
+            }
+            if (selected("downscale_grayscale", res)) {
+                run_bench("downscale_grayscale", isas[v], v == 0, res, bench_downscale, &m,
+                          (double)pixels, "mpix_per_s");
+            }
+            if (selected("apply_box_blur", res)) {
+                run_bench("apply_box_blur", isas[v], v == 0, res, bench_blur, &m, (double)pixels, "mpix_per_s");
+            }
+            if (selected("calculate_grid_motion", res)) {
+                run_bench("calculate_grid_motion", isas[v], v == 0, res, bench_grid, &m, (double)pixels, "mpix_per_s");
+            }
+            if (selected("update_background", res)) {
+                run_bench("update_background", isas[v], v == 0, res, bench_background, &m,
+                          (double)pixels, "mpix_per_s");
+            }
+            if (selected("motion_frame", res)) {
+                run_bench("motion_frame", isas[v], v == 0, res, bench_motion_frame, &m, (double)pixels, "mpix_per_s");
+            }
+        }
+        motion_kernels_use(NULL);
+
+        free(m.rgb);
+        free(m.gray);
+        free(m.prev);
+        free(m.background);
+        free(m.out);
+        free(m.temp);
+        free(m.sums);
+    }
+}
+
+#ifdef SOD_ENABLED
+/* SOD kernels */
+
+typedef struct {
+    int map_width;
+    int map_height;
+    float *input;       // BENCH_CONV_IN feature maps
+    float *columns;     // im2col matrix
+    float *weights;
+    float *output;
+    sod_img frame;
+    sod_box *boxes;
+    float *scores;
+    float *scores_work;
+    int box_count;
+} sod_bench_t;
+
+static void bench_gemm(void *arg) {
+    sod_bench_t *s = arg;
+    int m = BENCH_CONV_OUT;
+    int k = BENCH_CONV_IN * BENCH_CONV_KSIZE * BENCH_CONV_KSIZE;
+    int n = s->map_width * s->map_height;
+    sod_kernel_gemm(0, 0, m, n, k, 1.0f, s->weights, k, s->columns, n, 0.0f, s->output, n);
+}
+
+static void bench_im2col(void *arg) {
+    sod_bench_t *s = arg;
+    sod_kernel_im2col(s->input, BENCH_CONV_IN, s->map_height, s->map_width, BENCH_CONV_KSIZE, 1, 1, s->columns);
+}
+
+static void bench_resize(void *arg) {
+    sod_bench_t *s = arg;
+    sod_img resized = sod_resize_image(s->frame, BENCH_NET_SIZE, BENCH_NET_SIZE);
+    sod_free_image(resized);
+}
+
+static void bench_nms(void *arg) {
+    sod_bench_t *s = arg;
+    memcpy(s->scores_work, s->scores, s->box_count * sizeof(float));
+    sod_kernel_nms(s->boxes, s->scores_work, s->box_count, 0.45f);
+}
+
+static float *random_floats(size_t count) {
+    float *data = malloc(count * sizeof(float));
+    if (!data) {
+        fprintf(stderr, "Out of memory for SOD buffers\n");
+        exit(1);
+    }
+    for (size_t i = 0; i < count; i++) {
+        data[i] = (float)(bench_random() % 2001) / 1000.0f - 1.0f;
+    }
+    return data;
+}
+
+static void run_sod_benchmarks(void) {
+    const char *gemm_variants[MAX_VARIANTS];
+    const char *nms_variants[MAX_VARIANTS];
+    int gemm_count = sod_kernel_variants("gemm", gemm_variants, MAX_VARIANTS);
+    int nms_count = sod_kernel_variants("nms", nms_variants, MAX_VARIANTS);
+
+    for (size_t r = 0; r < sizeof(resolutions) / sizeof(resolutions[0]); r++) {
+        const resolution_t *res = &resolutions[r];
+        sod_bench_t s = {
+            .map_width = res->width / BENCH_CONV_STRIDE,
+            .map_height = res->height / BENCH_CONV_STRIDE,
+        };
+        size_t map = (size_t)s.map_width * s.map_height;
+        int k = BENCH_CONV_IN * BENCH_CONV_KSIZE * BENCH_CONV_KSIZE;
+
+        s.input = random_floats(map * BENCH_CONV_IN);
+        s.columns = random_floats(map * k);
+        s.weights = random_floats((size_t)BENCH_CONV_OUT * k);
+        s.output = random_floats(map * BENCH_CONV_OUT);
+
+        if (selected("gemm", res)) {
+            double flops = 2.0 * BENCH_CONV_OUT * k * (double)map;
+            for (int v = 0; v < gemm_count; v++) {
+                sod_kernel_use("gemm", gemm_variants[v]);
+                run_bench("gemm", gemm_variants[v], v == 0, res, bench_gemm, &s, flops, "gflops");
+            }
+            sod_kernel_use("gemm", NULL);
+        }
+
+        if (selected("im2col", res)) {
+            run_bench("im2col", "c", true, res, bench_im2col, &s, (double)map * k, "melem_per_s");
+        }
+
+        if (selected("sod_resize_image", res)) {
+            s.frame = sod_make_random_image(res->width, res->height, 3);
+            run_bench("sod_resize_image", "c", true, res, bench_resize, &s,
+                      (double)res->width * res->height, "mpix_per_s");
+            sod_free_image(s.frame);
+        }
+
+        // As many boxes as a detector with 3 anchors on a stride 32 grid proposes
+        if (selected("nms", res)) {
+            s.box_count = (res->width / 32) * (res->height / 32) * 3;
+            s.boxes = malloc(s.box_count * sizeof(sod_box));
+            s.scores = malloc(s.box_count * sizeof(float));
+            s.scores_work = malloc(s.box_count * sizeof(float));
+            if (!s.boxes || !s.scores || !s.scores_work) {
+                fprintf(stderr, "Out of memory for NMS buffers\n");
+                exit(1);
+            }
+            for (int i = 0; i < s.box_count; i++) {
+                // Boxes cluster around a few objects so that many overlap
+                int cx = (int)(bench_random() % 8) * res->width / 8;
+                int cy = (int)(bench_random() % 4) * res->height / 4;
+                s.boxes[i].x = cx + (int)(bench_random() % 40);
+                s.boxes[i].y = cy + (int)(bench_random() % 40);
+                s.boxes[i].w = res->width / 10 + (int)(bench_random() % 40);
+                s.boxes[i].h = res->height / 6 + (int)(bench_random() % 40);
+                s.scores[i] = (float)(bench_random() % 1000 + 1) / 1000.0f;
+            }
+            for (int v = 0; v < nms_count; v++) {
+                sod_kernel_use("nms", nms_variants[v]);
+                run_bench("nms", nms_variants[v], v == 0, res, bench_nms, &s, (double)s.box_count, "mboxes_per_s");
+            }
+            sod_kernel_use("nms", NULL);
+            free(s.boxes);
+            free(s.scores);
+            free(s.scores_work);
+        }
+
+        free(s.input);
+        free(s.columns);
+        free(s.weights);
+        free(s.output);
+    }
+}
+#endif /* SOD_ENABLED */
+
+static void usage(const char *program) {
+    fprintf(stderr, "Usage: %s [options]\n", program);
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  -t, --min-time SECONDS   Time spent per measurement (default: %.1f)\n", min_time);
+    fprintf(stderr, "  -k, --kernel NAME        Only kernels whose name contains NAME\n");
+    fprintf(stderr, "  -r, --resolution NAME    Only 360p, 720p, 1080p or 4k\n");
+    fprintf(stderr, "  -c, --csv                CSV instead of JSON\n");
+    fprintf(stderr, "  -h, --help               Show this help\n");
+}
+
+int main(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if ((strcmp(arg, "-t") == 0 || strcmp(arg, "--min-time") == 0) && has_value) {
+            min_time = atof(argv[++i]);
+        } else if ((strcmp(arg, "-k") == 0 || strcmp(arg, "--kernel") == 0) && has_value) {
+            filter = argv[++i];
+        } else if ((strcmp(arg, "-r") == 0 || strcmp(arg, "--resolution") == 0) && has_value) {
+            only_resolution = argv[++i];
+        } else if (strcmp(arg, "-c") == 0 || strcmp(arg, "--csv") == 0) {
+            csv = true;
+        } else {
+            usage(argv[0]);
+            return strcmp(arg, "-h") == 0 || strcmp(arg, "--help") == 0 ? 0 : 1;
+        }
+    }
+    if (min_time <= 0) {
+        min_time = 1.0;
+    }
+
+    // Set first, so nothing but results reaches stdout
+    set_log_level(LOG_LEVEL_ERROR);
+    init_logger();
+    stream_registry_init(sizeof(resolutions) / sizeof(resolutions[0]));
+    init_motion_detection_system();
+
+    if (!csv) {
+        struct utsname system;
+        uname(&system);
+        printf("{\n  \"machine\": \"%s\",\n  \"cpus\": %ld,\n  \"motion_isa\": \"%s\",\n  \"results\": [\n",
+               system.machine, sysconf(_SC_NPROCESSORS_ONLN), motion_kernels_isa());
+    }
+
+    run_motion_benchmarks();
+#ifdef SOD_ENABLED
+    run_sod_benchmarks();
+#endif
+
+    if (!csv) {
+        printf("\n  ]\n}\n");
+    }
+
+    if (slow_defaults > 0) {
+        fprintf(stderr, "%d default kernel variant(s) slower than an alternative\n", slow_defaults);
+    }
+
+    shutdown_motion_detection_system();
+    shutdown_logger();
+    return 0;
+}
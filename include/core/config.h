@@ -10,8 +10,21 @@
 #define MAX_STREAM_NAME 256
 // Maximum length for URLs
 #define MAX_URL_LENGTH 512
-// Maximum number of streams supported
-#define MAX_STREAMS 16
+// Upper bound for the max_streams setting; per-stream tables are sized from
+// max_streams at startup, so raising this only costs a few pointer tables
+#ifndef MAX_STREAMS
+#define MAX_STREAMS 64
+#endif
+// Default for the max_streams setting
+#define DEFAULT_MAX_STREAMS 16
+// Maximum length of a stream's detection zones in text form (see detection_zones.h)
+#define MAX_DETECTION_ZONES_TEXT 512
+// Maximum length of a stream's motion mask in text form (see motion_detection.h)
+#define MAX_MOTION_MASK_TEXT 264
+// Most web server event loops (web_event_loops)
+#define MAX_WEB_EVENT_LOOPS 8
+// Most live MJPEG connections (mjpeg_max_clients)
+#define MAX_MJPEG_CLIENTS 64
 
 // Stream protocol enum
 typedef enum {
@@ -19,6 +32,51 @@ typedef enum {
     STREAM_PROTOCOL_UDP = 1
 } stream_protocol_t;
 
+// Motion gating of object detection
+typedef enum {
+    MOTION_GATE_OFF = 0,     // Detect objects on every sampled frame
+    MOTION_GATE_FRAME = 1,   // Detect objects only on frames with motion
+    MOTION_GATE_REGION = 2   // Detect objects only in the part of the frame that moved
+} motion_gate_t;
+
+// How a stream's recordings are treated when the disk fills
+typedef enum {
+    RETENTION_CLASS_NORMAL = 0,      // Deleted in age order with the other streams
+    RETENTION_CLASS_CRITICAL = 1,    // Deleted only once no other recordings are left
+    RETENTION_CLASS_BEST_EFFORT = 2  // Deleted before the recordings of any other stream
+} retention_class_t;
+
+// Container of a stream's live HLS segments
+typedef enum {
+    HLS_SEGMENT_MPEGTS = 0,          // MPEG-TS segments (.ts)
+    HLS_SEGMENT_FMP4 = 1             // Fragmented MP4 (CMAF) segments (.m4s) with an init segment
+} hls_segment_format_t;
+
+// Worker threads that share scheduling settings ([threads] section)
+typedef enum {
+    THREAD_CLASS_INGEST = 0,     // Camera input
+    THREAD_CLASS_HLS,            // HLS writers
+    THREAD_CLASS_RECORDING,      // MP4 writers and recorders
+    THREAD_CLASS_DETECTION,      // Detection threads, workers and inference clients
+    THREAD_CLASS_WEB,            // Web server event loops and request workers
+    THREAD_CLASS_SERVICE,        // go2rtc supervisor, storage manager and other housekeeping
+    THREAD_CLASS_COUNT
+} thread_class_t;
+
+// Scheduling policy of a thread class
+typedef enum {
+    THREAD_POLICY_NORMAL = 0,    // SCHED_OTHER
+    THREAD_POLICY_BATCH = 1,     // SCHED_BATCH, throughput over latency
+    THREAD_POLICY_IDLE = 2       // SCHED_IDLE, only when no other thread wants the CPU
+} thread_policy_t;
+
+// Scheduling of one thread class
+typedef struct {
+    char cpus[64];               // CPUs the threads may run on, e.g. "4-7" or "0,2" (empty = any)
+    int nice;                    // Nice value of the threads (-20 to 19)
+    thread_policy_t policy;
+} thread_sched_config_t;
+
 // Stream configuration structure
 typedef struct {
     char name[MAX_STREAM_NAME];
@@ -35,11 +93,20 @@ typedef struct {
     char detection_model[MAX_PATH_LENGTH]; // Path to detection model file
     int detection_interval; // Frames between detection checks
     float detection_threshold; // Confidence threshold for detection
+    int detection_frame_step; // Detection sampling: 0 = key frames only, N = every Nth frame
+    char detection_url[MAX_URL_LENGTH]; // Optional sub-stream used for detection (empty = use url)
+    motion_gate_t detection_motion_gate; // Run object detection only where the motion detector fires
+    char detection_zones[MAX_DETECTION_ZONES_TEXT]; // Polygons detections must fall in (empty = whole frame)
+    char motion_mask[MAX_MOTION_MASK_TEXT]; // Grid cells motion detection ignores (empty = none)
     int pre_detection_buffer; // Seconds to keep before detection
     int post_detection_buffer; // Seconds to keep after detection
     bool streaming_enabled; // Whether HLS streaming is enabled for this stream
+    hls_segment_format_t hls_segment_format; // Container of the live HLS segments
     stream_protocol_t protocol; // Stream protocol (TCP, UDP, or ONVIF)
     bool record_audio; // Whether to record audio with video
+    int retention_days; // Days to keep recordings (0 = [storage] retention_days)
+    uint64_t max_storage_bytes; // Bytes the stream's recordings may use (0 = no quota)
+    retention_class_t retention_class; // Order in which recordings go when the disk fills
     
     // ONVIF specific fields
     char onvif_username[64];
@@ -55,28 +122,97 @@ typedef struct {
     char pid_file[MAX_PATH_LENGTH];
     char log_file[MAX_PATH_LENGTH];
     int log_level; // 0=ERROR, 1=WARN, 2=INFO, 3=DEBUG
+    bool log_async; // Write log lines from a background thread in batches
     
     // Storage settings
     char storage_path[MAX_PATH_LENGTH];
     char storage_path_hls[MAX_PATH_LENGTH]; // Path for HLS segments, overrides storage_path/hls when specified
+    bool hls_memory_store;    // Keep live HLS segments in memory instead of writing them to disk
+    bool hls_recording;       // Keep fMP4 HLS segments as the recording instead of muxing MP4 files
+    bool hls_low_latency;     // Also publish Low-Latency HLS with partial segments
+    int hls_part_duration_ms; // Target LL-HLS part duration in milliseconds (200-500)
+    bool hls_on_demand;       // Only write live HLS while someone requests it (needs shared ingest)
+    int hls_idle_timeout;     // Seconds without HLS requests before an on-demand stream stops writing
+    char hls_abr_renditions[64]; // Heights of the transcoded HLS renditions, e.g. "720,360"; empty for none
+    char hls_mosaic_streams[512]; // Streams tiled into the mosaic stream, "*" for all; empty for none
+    char hls_mosaic_name[MAX_STREAM_NAME]; // Name the mosaic is served under, /hls/<name>/index.m3u8
+    int hls_mosaic_fps;       // Frame rate of the mosaic (1-15)
+    int hls_mosaic_height;    // Height of the mosaic; its width is 16:9
     uint64_t max_storage_size; // in bytes
     int retention_days;
     bool auto_delete_oldest;
+    int min_free_percent;     // Free space below which the oldest recordings are deleted
+    int target_free_percent;  // Free space deletion stops at
+    int retention_priority_hours; // Each priority level makes a stream's recordings count as this much younger
+    char archive_path[MAX_PATH_LENGTH]; // Secondary storage aged recordings are moved to (empty = off)
+    int archive_after_hours;  // Age at which recordings are moved to archive_path
+    int archive_rate_kbps;    // Copy rate limit in KiB per second (0 = unlimited)
+    int compact_clip_seconds; // Finished clips shorter than this are compacted into hourly files (0 = off)
+    int compact_after_hours;  // Age at which an hour's clips are compacted
+    int thin_after_days;      // Age at which recordings are cut down to their key frames (0 = never)
+    char storage_volumes[1024]; // Further recording volumes, comma-separated (empty = MP4 path only)
+    char volume_placement[16];  // How streams are spread over volumes: round_robin, free_space or pinned
+    char volume_pins[512];      // stream=volume pairs for pinned placement
+    int storage_latency_slow_ms;     // p99 write or sync latency at which a disk is rated slow (0 = no monitor)
+    int storage_latency_critical_ms; // p99 latency at which a disk is rated critical
 
     // New recording format options
     bool record_mp4_directly;        // Record directly to MP4 alongside HLS
     char mp4_storage_path[256];      // Path for MP4 recordings storage
     int mp4_segment_duration;        // Duration of each MP4 segment in seconds
     int mp4_retention_days;          // Number of days to keep MP4 recordings
+    bool mp4_fragmented;             // Write fragmented MP4 so recordings survive power loss
+    bool mp4_standby;                // Keep an MP4 output ready for detection-triggered recordings
+    bool shard_recordings;           // New recordings go in <stream>/YYYY/MM/DD/HH directories
+    bool recording_thumbnails;       // Extract a thumbnail of each finished recording
+    int thumbnail_sprite_interval;   // Seconds between scrub sprite tiles (0 = no sprites)
     
     // Models settings
     char models_path[MAX_PATH_LENGTH]; // Path to detection models directory
+    int detection_workers;           // Worker threads running detection for all streams (0 = profile)
+    int detection_max_fps;           // Frames per second detected across all streams (0 = unlimited)
+    int detection_batch_size;        // Frames of different streams a SOD model runs at once (1 = no batching)
+    int detection_batch_window_ms;   // How long a batch waits for frames of other streams
+    bool detection_adaptive_interval; // Check quiet streams less often, full rate again on activity
+    bool motion_vectors;             // Motion gates of H.264 streams read the decoder's motion vectors
+    bool packet_activity_gate;       // Leave streams undecoded while their packet sizes show no activity
+    int detection_interval_min;      // Seconds between checks while active (0 = the stream's detection_interval)
+    int detection_interval_max;      // Seconds between checks of a stream that has been quiet for long
+    int tflite_threads;              // Interpreter threads per TFLite model (0 = cores divided between the workers)
+    char tflite_delegate[16];        // TFLite delegate: none, xnnpack, nnapi or edgetpu
+    bool tflite_warmup;              // Run a blank frame through TFLite models when they load
+    int model_memory_budget;         // MB of loaded models before the least recently used are unloaded (0 = no limit)
+    int model_idle_timeout;          // Seconds a model may go unused before it is unloaded (0 = never)
+    bool sod_opencl;                 // Run SOD models on the GPU through OpenCL where the build and driver allow
     
     // API detection settings
     char api_detection_url[MAX_URL_LENGTH]; // URL for the detection API
+    int api_detection_jpeg_quality;  // JPEG quality of the frames sent to the API (1-100)
+    int api_detection_max_inflight;  // Requests one stream may have out at once
+
+    // Remote inference settings
+    int remote_detection_timeout_ms; // How long a detection waits for the inference server
+    int remote_detection_jpeg_quality; // JPEG quality of the frames sent to the inference server (1-100)
+
+    // Shared-memory frame export settings
+    bool frame_export_enabled;       // Publish decoded detection frames in shared memory
+    char frame_export_streams[256];  // Comma-separated streams to export, empty for all
+    int frame_export_size;           // Largest width/height of an exported frame
+    int frame_export_slots;          // Frames kept in each stream's ring
+
+    // Load shedding settings
+    bool load_shedding_enabled;      // Shed detection work while CPU or memory stays high
+    int load_shed_cpu_high;          // CPU percent at which more work is shed
+    int load_shed_cpu_low;           // CPU percent below which shedding is undone
+    int load_shed_memory_high;       // Memory percent at which more work is shed
+    int load_shed_memory_low;        // Memory percent below which shedding is undone
+    int load_shed_pause_priority;    // Streams below this priority pause detection at the last step
 
     // Database settings
     char db_path[MAX_PATH_LENGTH];
+    bool db_compact_detections;      // Store detections as per-minute blobs of quantized boxes
+    bool db_partition_by_day;        // Store detections and events in one table per day
+    int db_slow_query_ms;            // Log statements running longer, with their plan (0 = off)
     
     // Web server settings
     int web_port;
@@ -85,6 +221,18 @@ typedef struct {
     char web_username[32];
     char web_password[32]; // Stored as hash in actual implementation
     bool webrtc_disabled;  // Whether WebRTC is disabled (use HLS only)
+    int web_thread_pool_size;        // Worker threads running offloaded API requests
+    int web_request_queue_size;      // Requests waiting for a worker before new ones get 503
+    int web_route_max_concurrency;   // Workers one API route may occupy at once (0 = no limit)
+    int web_event_loops;             // Event loops accepting connections on the web port (SO_REUSEPORT when > 1)
+    int web_max_connections;         // Open web connections across all event loops (0 = no limit)
+    int web_max_connections_per_ip;  // Open web connections of one client address (0 = no limit)
+    int web_header_timeout;          // Seconds a new connection has to send its request headers (0 = no limit)
+    int web_idle_timeout;            // Seconds a connection may go without reads or writes (0 = no limit)
+    int web_send_buffer_kb;          // KiB queued on a connection before its response waits for it to drain
+    int mjpeg_fps;                   // Frames per second of the live MJPEG streams
+    int mjpeg_width;                 // Width of live MJPEG frames (0 = the stream's own)
+    int mjpeg_max_clients;           // Live MJPEG connections across all streams (0 = disabled)
     
     // Web optimization settings
     bool web_compression_enabled;    // Whether to enable gzip compression for text-based responses
@@ -102,24 +250,62 @@ typedef struct {
     char onvif_discovery_network[64]; // Network to scan for ONVIF devices (e.g., "192.168.1.0/24")
     
     // Stream settings
-    int max_streams;
-    stream_config_t streams[MAX_STREAMS];
+    int max_streams;                 // Stream capacity, fixed at startup (1 to MAX_STREAMS)
+    stream_config_t *streams;        // max_streams entries, allocated by load_config
+    int startup_concurrency;         // Streams brought up at once after startup (1-16)
+
+    // Shared ingest settings
+    bool shared_ingest_enabled;      // Demux each camera once and fan packets out to HLS, MP4 and detection
+    int ingest_queue_depth;          // Per-consumer packet queue depth for the shared ingest (0 = profile)
+    bool ingest_gop_cache;           // Keep each stream's newest GOP to start live consumers at once
+
+    // UDP ingest tuning
+    int udp_buffer_size;             // Socket receive buffer of UDP/RTP inputs in KB
+    int udp_reorder_queue_size;      // RTP packets held to put reordered packets back in order
+    int udp_fifo_size;               // Buffer filled by FFmpeg's reader thread for udp:// inputs in KB
     
     // Memory optimization
     int buffer_size; // in KB
     bool use_swap;
     char swap_file[MAX_PATH_LENGTH];
     uint64_t swap_size; // in bytes
+    int memory_budget_mb; // Tracked memory above which optional work is skipped (0 = no budget, -1 = profile)
+    char device_profile[16]; // Tier sizing buffers and caches: auto, small, medium or large
+    int db_cache_kb;      // SQLite page cache (0 = profile)
+    int db_mmap_mb;       // SQLite memory-mapped I/O (0 = off, -1 = profile)
+    int storage_cache_ttl; // Seconds per-stream storage usage is cached (0 = profile)
+    int log_buffer_entries; // Recent log entries kept in memory (0 = profile)
     bool memory_constrained; // Flag for memory-constrained devices
     
+    // Thread scheduling, indexed by thread_class_t
+    thread_sched_config_t thread_sched[THREAD_CLASS_COUNT];
+
     // Hardware acceleration
     bool hw_accel_enabled;
     char hw_accel_device[32];
+    bool transcode_hevc;        // Offer H.264 transcodes of HEVC streams and recordings to browsers
+    int transcode_max_software; // Software H.264 encoders that may run at once (0 = hardware only)
     
     // go2rtc settings
     char go2rtc_binary_path[MAX_PATH_LENGTH];
     char go2rtc_config_dir[MAX_PATH_LENGTH];
     int go2rtc_api_port;
+    bool go2rtc_upstream;           // go2rtc holds the only camera connection, all consumers pull from it
+
+    // Federation settings
+    bool federation_enabled;         // Answer /api/federation/* for this node and its peers
+    char federation_node_name[64];   // Name of this node in federated results
+    char federation_peers[1024];     // Comma-separated name=url of the peer nodes
+    char federation_auth[128];       // user:password the peers are asked with, empty for none
+    int federation_timeout_ms;       // How long a peer may take to answer
+    int federation_cache_ttl;        // Seconds a peer's response is reused (0 = not cached)
+
+    // Upload settings
+    char upload_url[MAX_URL_LENGTH]; // Base URL event clips are uploaded to (empty = off)
+    char upload_auth[256];           // user:password, or access_key:secret_key with upload_s3_region
+    char upload_s3_region[32];       // Sign as S3 in this region and use multipart uploads (empty = plain PUT)
+    int upload_rate_kbps;            // Upload rate limit in KiB per second (0 = unlimited)
+    int upload_max_attempts;         // Attempts before a clip is given up
 } config_t;
 
 /**
@@ -190,6 +376,64 @@ int load_stream_configs(config_t *config);
  */
 int save_stream_configs(const config_t *config);
 
+/**
+ * Change the max_streams setting
+ * The stream tables are sized at startup, so the new value is only written
+ * to the configuration file by save_config and takes effect on restart.
+ * 
+ * @param max_streams New stream capacity (1 to MAX_STREAMS)
+ * @return 0 on success, -1 if the value is out of range
+ */
+int request_max_streams(int max_streams);
+
+/**
+ * Get the name of a thread class, as used for the keys of the [threads] section
+ *
+ * @param thread_class Thread class
+ * @return Class name, "unknown" if out of range
+ */
+const char *thread_class_name(thread_class_t thread_class);
+
+/**
+ * Get the name of a thread policy as written to the configuration
+ *
+ * @param policy Policy
+ * @return "normal", "batch" or "idle"
+ */
+const char *thread_policy_name(thread_policy_t policy);
+
+/**
+ * Parse an HLS segment format name
+ *
+ * @param name "fmp4" or "mpegts"
+ * @return The format, HLS_SEGMENT_MPEGTS for unknown names
+ */
+hls_segment_format_t parse_hls_segment_format(const char *name);
+
+/**
+ * Get the name of an HLS segment format, as accepted by parse_hls_segment_format
+ *
+ * @param format Segment format
+ * @return Format name
+ */
+const char *hls_segment_format_name(hls_segment_format_t format);
+
+/**
+ * Parse a retention class name
+ *
+ * @param name "critical", "best_effort" or "normal"
+ * @return The class, RETENTION_CLASS_NORMAL for unknown names
+ */
+retention_class_t parse_retention_class(const char *name);
+
+/**
+ * Get the name of a retention class, as accepted by parse_retention_class
+ *
+ * @param retention_class Retention class
+ * @return Class name
+ */
+const char *retention_class_name(retention_class_t retention_class);
+
 /**
  * Set a custom configuration file path
  * This path will be checked first when loading configuration
@@ -0,0 +1,93 @@
+/**
+ * Device Profile
+ *
+ * At startup the memory (or the cgroup limit, if lower), the usable cores
+ * and the SIMD extensions of the machine are detected and the device is
+ * put in a tier:
+ *
+ *   small:  less than 1 GiB, such as single-board computers and camera SoCs
+ *   medium: less than 4 GiB
+ *   large:  4 GiB or more
+ *
+ * The tier sizes buffers, caches and pools together, so a small board does
+ * not get a server's SQLite cache and a server does not get a board's
+ * ingest queues. Each size can still be set in the configuration; only
+ * those left on auto are taken from the profile. The profile is computed
+ * once, changes to the configuration take effect after a restart.
+ */
+
+#ifndef LIGHTNVR_DEVICE_PROFILE_H
+#define LIGHTNVR_DEVICE_PROFILE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "core/config.h"
+
+typedef enum {
+    DEVICE_TIER_SMALL = 0,
+    DEVICE_TIER_MEDIUM,
+    DEVICE_TIER_LARGE
+} device_tier_t;
+
+// Sizes chosen by the profile
+typedef enum {
+    DEVICE_KNOB_MEMORY_BUDGET_MB = 0,   // [memory] budget_mb
+    DEVICE_KNOB_DETECTION_WORKERS,      // [models] detection_workers
+    DEVICE_KNOB_INGEST_QUEUE_DEPTH,     // [streams] ingest_queue_depth
+    DEVICE_KNOB_DB_CACHE_KB,            // [memory] db_cache_kb
+    DEVICE_KNOB_DB_MMAP_MB,             // [memory] db_mmap_mb
+    DEVICE_KNOB_STORAGE_CACHE_TTL,      // [memory] storage_cache_ttl
+    DEVICE_KNOB_LOG_BUFFER_ENTRIES,     // [memory] log_buffer_entries
+    DEVICE_KNOB_COUNT
+} device_knob_t;
+
+// A size and where it came from
+typedef struct {
+    const char *name;           // Configuration key
+    int value;                  // Size in use
+    int profile_value;          // Size the profile chose
+    bool configured;            // Set in the configuration rather than by the profile
+} device_knob_value_t;
+
+typedef struct {
+    device_tier_t tier;
+    bool tier_configured;       // [memory] profile named the tier
+    uint64_t memory_bytes;      // Memory available to the process
+    int cores;                  // Cores the process may run on
+    char simd[64];              // SIMD extensions of the CPU, comma separated, "none" without
+    device_knob_value_t knobs[DEVICE_KNOB_COUNT];
+} device_profile_t;
+
+/**
+ * Detect the device and choose the sizes
+ * Called once the configuration is loaded; a later call does nothing.
+ *
+ * @param config Configuration with the sizes set by the user
+ */
+void device_profile_init(const config_t *config);
+
+/**
+ * Get the profile, detected from g_config if device_profile_init() was not called
+ *
+ * @return Profile, valid for the lifetime of the process
+ */
+const device_profile_t *device_profile_get(void);
+
+/**
+ * Get a size in use
+ *
+ * @param knob Size to get
+ * @return Value, in the unit of its configuration key
+ */
+int device_profile_value(device_knob_t knob);
+
+/**
+ * Name of a tier, for logs and the API
+ *
+ * @param tier Tier
+ * @return Static string
+ */
+const char *device_tier_name(device_tier_t tier);
+
+#endif /* LIGHTNVR_DEVICE_PROFILE_H */
@@ -0,0 +1,98 @@
+/**
+ * @file event_bus.h
+ * @brief In-process bus linking what the pipeline detects to what acts on it
+ *
+ * Producers (detection threads, motion detection, ONVIF events, MP4
+ * writers) publish typed events instead of calling the components that
+ * act on them. Every subscriber has its own bounded ring, filled by any
+ * number of producers without locks, and its own dispatch thread that
+ * hands the events to its handler in the order they were published.
+ *
+ * Publishing copies the event into the ring of each subscriber to its type
+ * and never waits: when a subscriber falls behind and its ring is full,
+ * the event is dropped for that subscriber only and counted in
+ * lightnvr_event_drops_total{subscriber}. Published events are counted in
+ * lightnvr_events_total{type}, and the time from publishing to handling in
+ * lightnvr_event_delay_seconds{subscriber}.
+ *
+ * Subscriptions last until event_bus_shutdown(), which lets every
+ * subscriber finish the events already in its ring.
+ */
+
+#ifndef LIGHTNVR_EVENT_BUS_H
+#define LIGHTNVR_EVENT_BUS_H
+
+#include <stdint.h>
+#include <time.h>
+
+#include "core/config.h"
+#include "core/pipeline_trace.h"
+#include "video/detection_result.h"
+
+// Most subscribers; subscribing more fails
+#define EVENT_BUS_MAX_SUBSCRIBERS 16
+
+// Ring size used when a subscriber asks for none; sizes are rounded up to a power of two
+#define EVENT_BUS_DEFAULT_CAPACITY 64
+
+typedef enum {
+    BUS_EVENT_DETECTION = 0,            // Model results for a frame, also when nothing was found
+    BUS_EVENT_MOTION,                   // Motion found in a frame; result holds its region
+    BUS_EVENT_ONVIF_MOTION,             // Motion reported by the camera; result holds a full-frame "motion"
+    BUS_EVENT_RECORDING_FINISHED,       // Recording closed, its file final
+    BUS_EVENT_TYPE_COUNT
+} bus_event_type_t;
+
+// Bit of an event type in a subscription's type mask
+#define BUS_EVENT_MASK(type) (1u << (type))
+
+typedef struct {
+    bus_event_type_t type;
+    char stream_name[MAX_STREAM_NAME];
+    time_t time;                // Wall-clock time of the frame or event
+    int64_t pts;                // PTS of the frame in the stream's time base, -1 if unknown
+    float threshold;            // Confidence the stream's detections are kept at
+    uint64_t recording_id;      // BUS_EVENT_RECORDING_FINISHED
+    detection_result_t result;
+    pipeline_trace_t trace;     // Set by event_bus_publish from the publisher's current trace
+    uint64_t published_us;      // Set by event_bus_publish
+} bus_event_t;
+
+/**
+ * Handler of a subscriber, run on its dispatch thread
+ * The publisher's trace context is current while it runs.
+ *
+ * @param event Event, valid during the call only
+ * @param ctx Context given to event_bus_subscribe()
+ */
+typedef void (*bus_event_handler_t)(const bus_event_t *event, void *ctx);
+
+/**
+ * Subscribe to events and start the subscriber's dispatch thread
+ *
+ * @param name Short name for metrics, logs and the thread name; a name
+ *             already subscribed is left as it is
+ * @param types BUS_EVENT_MASK() bits of the event types to receive
+ * @param capacity Events the ring holds, 0 for EVENT_BUS_DEFAULT_CAPACITY
+ * @param handler Handler
+ * @param ctx Passed to the handler
+ * @return 0 on success or when the name is already subscribed, -1 on error
+ */
+int event_bus_subscribe(const char *name, uint32_t types, int capacity,
+                        bus_event_handler_t handler, void *ctx);
+
+/**
+ * Publish an event to its subscribers without blocking
+ *
+ * @param event Event; trace and published_us are filled in
+ * @return Number of subscribers the event was queued for
+ */
+int event_bus_publish(bus_event_t *event);
+
+/**
+ * Stop the dispatch threads once their rings are empty
+ * Events published afterwards are dropped.
+ */
+void event_bus_shutdown(void);
+
+#endif // LIGHTNVR_EVENT_BUS_H
@@ -3,6 +3,7 @@
 
 #include <stdarg.h>
 #include <stddef.h>
+#include <stdint.h>
 
 // Log levels
 // Change your logger.h enum to avoid conflicting with syslog.h
@@ -13,6 +14,26 @@ typedef enum {
     LOG_LEVEL_DEBUG = 3
 } log_level_t;
 
+// Most recent log entries kept in memory; set_log_buffer_entries() may keep fewer
+#define LOG_RING_SIZE 1024
+
+// Longest message kept in memory; longer messages are truncated
+#define LOG_RING_MESSAGE_SIZE 512
+
+// Longest line the asynchronous logger queues; longer lines are written directly
+#define LOG_QUEUE_LINE_SIZE 1024
+
+// How often the asynchronous logger flushes when no error forces it
+#define LOG_ASYNC_FLUSH_MS 100
+
+// A log entry kept in memory
+typedef struct {
+    uint64_t seq;                       // Sequence number, starting at 1
+    log_level_t level;
+    char timestamp[20];                 // "YYYY-MM-DD HH:MM:SS", local time
+    char message[LOG_RING_MESSAGE_SIZE];
+} log_entry_t;
+
 /**
  * Initialize the logging system
  * 
@@ -40,6 +61,19 @@ void set_log_level(log_level_t level);
  */
 int set_log_file(const char *filename);
 
+/**
+ * Write log lines from a background thread
+ * 
+ * Logging calls queue the formatted line and return; the thread writes the
+ * queued lines in batches and flushes them every LOG_ASYNC_FLUSH_MS, or right
+ * away when an error is logged. Lines too long for the queue, or logged while
+ * it is full, are written directly.
+ * 
+ * @param enable Non-zero to start the thread, zero to write what is queued and stop it
+ * @return 0 on success, non-zero on failure
+ */
+int set_log_async(int enable);
+
 /**
  * Enable or disable console logging
  * 
@@ -109,6 +143,63 @@ void log_message_v(log_level_t level, const char *format, va_list args);
  */
 int log_rotate(size_t max_size, int max_files);
 
+/**
+ * State of one rate-limited log call site
+ */
+typedef struct {
+    _Atomic long window_start;          // Monotonic second the current window began
+    _Atomic int count;                  // Messages in the current window
+    _Atomic int suppressed;             // Messages dropped in the current window
+} log_ratelimit_t;
+
+/**
+ * Count a message against its call site's limit
+ * 
+ * @param rl Call site state
+ * @param interval Window length in seconds
+ * @param burst Messages allowed per window
+ * @param suppressed Set to the number of messages dropped in the previous
+ *                   window when this message starts a new one, 0 otherwise
+ * @return Non-zero if the message should be logged
+ */
+int log_ratelimit(log_ratelimit_t *rl, int interval, int burst, int *suppressed);
+
+/**
+ * Copy the newest log entries kept in memory
+ * 
+ * Reading never blocks the logger and does not touch the log file. Entries
+ * come back oldest first.
+ * 
+ * @param after_seq Only return entries with a higher sequence number (0 for all)
+ * @param max_level Only return entries at this level or more severe
+ * @param entries Array to fill
+ * @param max_entries Size of the array
+ * @param last_seq Set to the sequence number to resume from next time (optional)
+ * @return Number of entries copied
+ */
+int get_recent_logs(uint64_t after_seq, log_level_t max_level, log_entry_t *entries,
+                    int max_entries, uint64_t *last_seq);
+
+/**
+ * Forget the log entries kept in memory, e.g. after the log file is cleared
+ */
+void clear_recent_logs(void);
+
+/**
+ * Set how many recent log entries are kept in memory
+ * Slots past the count are never written, so their pages are not touched.
+ *
+ * @param entries Entries, clamped to 16..LOG_RING_SIZE
+ */
+void set_log_buffer_entries(int entries);
+
+/**
+ * Get the memory taken by the log ring and the asynchronous log queue
+ *
+ * @return Bytes
+ */
+size_t get_logger_memory_usage(void);
+
 /**
  * Get the string representation of a log level
  * 
@@ -117,4 +208,52 @@ int log_rotate(size_t max_size, int max_files);
  */
 const char *get_log_level_string(log_level_t level);
 
+// Most verbose level compiled in; calls above it compile to nothing, so
+// their arguments are not evaluated (0=ERROR, 1=WARN, 2=INFO, 3=DEBUG)
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL 3
+#endif
+
+// The arguments stay type-checked and their variables stay used
+#define LOG_ELIDED(fn, ...) do { if (0) { (fn)(__VA_ARGS__); } } while (0)
+
+#if LOG_COMPILE_LEVEL < 3
+#define log_debug(...) LOG_ELIDED(log_debug, __VA_ARGS__)
+#endif
+#if LOG_COMPILE_LEVEL < 2
+#define log_info(...) LOG_ELIDED(log_info, __VA_ARGS__)
+#endif
+#if LOG_COMPILE_LEVEL < 1
+#define log_warn(...) LOG_ELIDED(log_warn, __VA_ARGS__)
+#endif
+
+// Default limit of the log_*_ratelimited calls: messages per call site per window
+#define LOG_RATELIMIT_BURST 5
+#define LOG_RATELIMIT_INTERVAL 60
+
+/**
+ * Log at most LOG_RATELIMIT_BURST messages per LOG_RATELIMIT_INTERVAL seconds
+ * from this call site, for paths that run per packet, frame or reconnect
+ * attempt. The first message of a window reports how many were dropped in
+ * the one before.
+ */
+#define log_ratelimited(level, ...) do { \
+    if ((level) <= LOG_COMPILE_LEVEL) { \
+        static log_ratelimit_t log_rl_; \
+        int log_rl_suppressed_ = 0; \
+        if (log_ratelimit(&log_rl_, LOG_RATELIMIT_INTERVAL, LOG_RATELIMIT_BURST, &log_rl_suppressed_)) { \
+            if (log_rl_suppressed_ > 0) { \
+                log_message((level), "Suppressed %d similar messages from %s:%d", \
+                            log_rl_suppressed_, __FILE__, __LINE__); \
+            } \
+            log_message((level), __VA_ARGS__); \
+        } \
+    } \
+} while (0)
+
+#define log_error_ratelimited(...) log_ratelimited(LOG_LEVEL_ERROR, __VA_ARGS__)
+#define log_warn_ratelimited(...) log_ratelimited(LOG_LEVEL_WARN, __VA_ARGS__)
+#define log_info_ratelimited(...) log_ratelimited(LOG_LEVEL_INFO, __VA_ARGS__)
+#define log_debug_ratelimited(...) log_ratelimited(LOG_LEVEL_DEBUG, __VA_ARGS__)
+
 #endif // LIGHTNVR_LOGGER_H
@@ -0,0 +1,119 @@
+/**
+ * @file metrics.h
+ * @brief Pipeline counters, gauges and latency histograms in Prometheus text format
+ *
+ * Each series is registered once by name and labels, and the ID handed back
+ * is kept by the component that updates it. Updates are lock-free: every
+ * series holds a few cache-line sized shards and each thread adds to its own,
+ * so threads sharing a series do not contend. Shards are summed on scrape.
+ */
+
+#ifndef LIGHTNVR_METRICS_H
+#define LIGHTNVR_METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Most series kept; registering more fails and the updates are dropped
+#define METRICS_MAX_SERIES 1024
+
+// Most metric names (families) kept
+#define METRICS_MAX_FAMILIES 64
+
+// Shards per series; threads are spread across them round-robin
+#define METRICS_SHARDS 4
+
+// Most functions run before each scrape
+#define METRICS_MAX_COLLECTORS 8
+
+// Histogram bucket count, not counting +Inf; bounds are 1 ms to 10 s
+#define METRICS_HISTOGRAM_BUCKETS 13
+
+// Series ID, 0 when the series could not be registered
+typedef int metric_t;
+
+/**
+ * Register a counter, or look up the one already registered
+ *
+ * @param name Metric name, e.g. "lightnvr_stream_reconnects_total"
+ * @param help Description for the HELP line
+ * @param ... Label name and value pairs, terminated by NULL
+ * @return Series ID, 0 on failure
+ */
+metric_t metrics_counter(const char *name, const char *help, ...);
+
+/**
+ * Register a latency histogram, or look up the one already registered
+ *
+ * @param name Metric name in seconds, e.g. "lightnvr_db_query_seconds"
+ * @param help Description for the HELP line
+ * @param ... Label name and value pairs, terminated by NULL
+ * @return Series ID, 0 on failure
+ */
+metric_t metrics_histogram(const char *name, const char *help, ...);
+
+/**
+ * Register a gauge, or look up the one already registered
+ * Gauges hold the last value set, typically from a collector.
+ *
+ * @param name Metric name, e.g. "lightnvr_memory_bytes"
+ * @param help Description for the HELP line
+ * @param ... Label name and value pairs, terminated by NULL
+ * @return Series ID, 0 on failure
+ */
+metric_t metrics_gauge(const char *name, const char *help, ...);
+
+/**
+ * Set a gauge
+ *
+ * @param metric Series ID, 0 is ignored
+ * @param value New value
+ */
+void metrics_set(metric_t metric, uint64_t value);
+
+/**
+ * Run a function before every scrape, to bring gauges up to date
+ *
+ * @param collect Function setting gauges; must not register metrics
+ * @return 0 on success, -1 if too many collectors are registered
+ */
+int metrics_add_collector(void (*collect)(void));
+
+/**
+ * Add to a counter
+ *
+ * @param metric Series ID, 0 is ignored
+ * @param value Amount to add
+ */
+void metrics_add(metric_t metric, uint64_t value);
+
+/**
+ * Record one observation in a histogram
+ *
+ * @param metric Series ID, 0 is ignored
+ * @param us Observed duration in microseconds
+ */
+void metrics_observe_us(metric_t metric, uint64_t us);
+
+/**
+ * Current monotonic time in microseconds, for timing observations
+ */
+uint64_t metrics_now_us(void);
+
+/**
+ * Record the time since a metrics_now_us() reading in a histogram
+ *
+ * @param metric Series ID, 0 is ignored
+ * @param start_us Reading taken when the timed operation started
+ */
+void metrics_observe_since(metric_t metric, uint64_t start_us);
+
+/**
+ * Format all series in the Prometheus text exposition format
+ *
+ * @param len Set to the length of the text (optional)
+ * @return Text to free with free(), NULL on allocation failure
+ */
+char *metrics_format(size_t *len);
+
+#endif // LIGHTNVR_METRICS_H
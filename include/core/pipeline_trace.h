@@ -0,0 +1,158 @@
+/**
+ * @file pipeline_trace.h
+ * @brief End-to-end latency of frames through the pipeline
+ *
+ * The ingest stamps every packet with a trace context: when it was demuxed
+ * and its PTS. The context travels with the packet through the consumer
+ * queues, and each stage a frame reaches records the age of the frame at
+ * that point in lightnvr_pipeline_latency_seconds{stream,stage}:
+ *
+ *   demux             Delay of the packet against the camera's clock (PTS),
+ *                     relative to the least delayed packet of the last minutes
+ *   enqueue           Handed to every consumer queue
+ *   dequeue_<name>    Taken from its queue by a consumer (hls, mp4, detection)
+ *   decode            Decoded for detection
+ *   inference         Detection finished
+ *   db_commit         Its detections committed to the database
+ *   segment_close     HLS segment it starts closed
+ *   playlist_update   Playlist listing that segment written, i.e. playable
+ *
+ * Ages are measured from the demux, so the stages of one stream add up along
+ * a path: dequeue_detection, decode, inference and db_commit grow from one to
+ * the next. The HLS stages are measured for the first frame of a segment,
+ * the frame that waits the longest for it to become playable.
+ *
+ * For a sampled window the stages of sampled frames are also kept as events
+ * and can be exported as Chrome trace-event JSON (chrome://tracing, Perfetto).
+ */
+
+#ifndef LIGHTNVR_PIPELINE_TRACE_H
+#define LIGHTNVR_PIPELINE_TRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "core/metrics.h"
+
+// Stage names of the latency histograms
+#define PIPELINE_STAGE_DEMUX "demux"
+#define PIPELINE_STAGE_ENQUEUE "enqueue"
+#define PIPELINE_STAGE_DECODE "decode"
+#define PIPELINE_STAGE_INFERENCE "inference"
+#define PIPELINE_STAGE_DB_COMMIT "db_commit"
+#define PIPELINE_STAGE_SEGMENT_CLOSE "segment_close"
+#define PIPELINE_STAGE_PLAYLIST_UPDATE "playlist_update"
+
+// Stream and stage pairs kept; stages of further streams are not traced
+#define PIPELINE_TRACE_MAX_SERIES 256
+
+// Events kept per capture window
+#define PIPELINE_TRACE_MAX_EVENTS 65536
+
+// Longest capture window in seconds
+#define PIPELINE_TRACE_MAX_WINDOW 60
+
+/**
+ * Trace context of a packet and the frame decoded from it
+ */
+typedef struct {
+    int64_t recv_us;        // metrics_now_us() when demuxed, 0 when not traced
+    int64_t pts;            // PTS in the input stream's time base
+    bool sampled;           // Stages are kept as events of the capture window
+} pipeline_trace_t;
+
+/**
+ * Delay estimator for the demux stage of one connection
+ * Zero it when the connection (and with it the PTS timeline) changes.
+ */
+typedef struct {
+    int64_t min_offset_us;      // Least (arrival - PTS) of the current window
+    int64_t prev_min_offset_us; // Of the previous window
+    int64_t window_start_us;
+    bool valid;
+} pipeline_clock_t;
+
+/**
+ * Register the latency histogram of a stage of a stream, or look it up
+ *
+ * @param stream_name Stream name
+ * @param stage Stage name, one of PIPELINE_STAGE_* or dequeue_<consumer>
+ * @return Series ID, 0 on failure
+ */
+metric_t pipeline_trace_metric(const char *stream_name, const char *stage);
+
+/**
+ * Stamp a packet as it leaves the demuxer
+ * Video packets are sampled for the capture window when one is running.
+ *
+ * @param trace Context to fill
+ * @param pts PTS of the packet
+ * @param is_video Whether the packet is video
+ */
+void pipeline_trace_stamp(pipeline_trace_t *trace, int64_t pts, bool is_video);
+
+/**
+ * Record that a traced frame reached a stage, observing its age
+ *
+ * @param metric Histogram from pipeline_trace_metric(), 0 is ignored
+ * @param trace Context of the frame; untraced contexts are ignored
+ */
+void pipeline_trace_stage(metric_t metric, const pipeline_trace_t *trace);
+
+/**
+ * Record the demux delay of a traced packet
+ *
+ * @param metric Histogram of the demux stage
+ * @param clock Estimator of the connection
+ * @param trace Context from pipeline_trace_stamp()
+ * @param pts_us PTS of the packet in microseconds
+ */
+void pipeline_trace_demux(metric_t metric, pipeline_clock_t *clock, const pipeline_trace_t *trace,
+                          int64_t pts_us);
+
+/**
+ * Make a context the current one of the calling thread
+ * Lets code further down the call chain (e.g. the detection writer) pick up
+ * the frame being processed without passing it through every call.
+ *
+ * @param trace Context, NULL to clear
+ */
+void pipeline_trace_set_current(const pipeline_trace_t *trace);
+
+/**
+ * Get the current context of the calling thread
+ *
+ * @param trace Receives the context, zeroed when there is none
+ */
+void pipeline_trace_get_current(pipeline_trace_t *trace);
+
+/**
+ * Start a capture window
+ * Stages of sampled frames are kept as events until the window ends or
+ * PIPELINE_TRACE_MAX_EVENTS are kept. Events of the previous window are dropped.
+ *
+ * @param seconds Length of the window, up to PIPELINE_TRACE_MAX_WINDOW
+ * @param every Sample every Nth video frame
+ * @return 0 on success, -1 on failure
+ */
+int pipeline_trace_capture_start(int seconds, int every);
+
+/**
+ * Get the state of the capture window
+ *
+ * @param capturing Set when a window is running (may be NULL)
+ * @param events Set to the number of events kept (may be NULL)
+ */
+void pipeline_trace_capture_status(bool *capturing, int *events);
+
+/**
+ * Format the events of the last capture window as Chrome trace-event JSON
+ * Each stream is a thread, each stage of a frame a complete event spanning
+ * from the demux to the stage.
+ *
+ * @param len Set to the length of the text (optional)
+ * @return Text to free with free(), NULL on allocation failure
+ */
+char *pipeline_trace_format_events(size_t *len);
+
+#endif // LIGHTNVR_PIPELINE_TRACE_H
@@ -0,0 +1,69 @@
+/**
+ * @file profiler.h
+ * @brief Sampling CPU profiler for devices without perf
+ *
+ * Built in with -DENABLE_PROFILER=ON. While a profile runs, a SIGPROF timer
+ * interrupts the process every 1/hz seconds of CPU time it uses, and the
+ * signal handler records the call stack of the thread that was running and
+ * the thread's name. The result is in the folded stack format read by
+ * flamegraph.pl, inferno and speedscope, one line per distinct stack with the
+ * thread name as its root frame:
+ *
+ *   hls:front;hls_unified_thread_func;hls_writer_write_packet;av_write_frame 42
+ *
+ * Stacks are walked with libunwind when the build finds it, with glibc's
+ * backtrace() otherwise. Functions are named from the dynamic symbol table;
+ * static functions show up as module+offset, for addr2line on a build with
+ * debug information.
+ */
+
+#ifndef LIGHTNVR_PROFILER_H
+#define LIGHTNVR_PROFILER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Longest profile in seconds
+#define PROFILER_MAX_SECONDS 300
+
+// Sampling rate; 99 rather than 100 Hz so samples do not lock step with periodic work
+#define PROFILER_DEFAULT_HZ 99
+#define PROFILER_MAX_HZ 1000
+
+// Samples kept per profile and frames kept per sample
+#define PROFILER_MAX_SAMPLES 16384
+#define PROFILER_MAX_DEPTH 32
+
+// Errors of profiler_run()
+#define PROFILER_ERR_UNAVAILABLE -2  // Not built in
+#define PROFILER_ERR_BUSY -3         // Another profile is running
+
+/**
+ * Result of a profile
+ */
+typedef struct {
+    char *folded;       // Folded stacks, to free with free()
+    size_t len;         // Length of folded
+    int samples;        // Samples taken
+    int dropped;        // Samples beyond PROFILER_MAX_SAMPLES, not in folded
+} profile_result_t;
+
+/**
+ * Check whether the profiler is built in
+ *
+ * @return true if profiler_run() can profile
+ */
+bool profiler_available(void);
+
+/**
+ * Profile the process, blocking the calling thread for the whole time
+ * Ends early when shutdown is initiated. Only one profile runs at a time.
+ *
+ * @param seconds Length of the profile, up to PROFILER_MAX_SECONDS
+ * @param hz Samples per second of CPU time, up to PROFILER_MAX_HZ
+ * @param result Receives the folded stacks
+ * @return 0 on success, PROFILER_ERR_UNAVAILABLE, PROFILER_ERR_BUSY or -1 on other errors
+ */
+int profiler_run(int seconds, int hz, profile_result_t *result);
+
+#endif // LIGHTNVR_PROFILER_H
@@ -4,10 +4,19 @@
 #include <stdatomic.h>
 #include <stdbool.h>
 #include <pthread.h>
+#include <time.h>
 
 // Maximum number of components that can register with the coordinator
 #define MAX_COMPONENTS 32
 
+// Priorities of the component tiers, higher tiers are stopped first
+#define COMPONENT_PRIORITY_DETECTION 100
+#define COMPONENT_PRIORITY_HLS 60
+#define COMPONENT_PRIORITY_MP4 10
+
+// Time given to all component tiers together to stop during shutdown
+#define SHUTDOWN_STOP_TIMEOUT_MS 10000
+
 // Component states
 typedef enum {
     COMPONENT_RUNNING = 0,
@@ -40,7 +49,9 @@ typedef struct {
     component_info_t components[MAX_COMPONENTS];
     pthread_mutex_t mutex;
     pthread_cond_t all_stopped_cond;
+    pthread_cond_t state_changed_cond;  // Broadcast whenever a component stops
     bool all_components_stopped;
+    struct timespec shutdown_started;   // CLOCK_MONOTONIC, when shutdown was initiated
 } shutdown_coordinator_t;
 
 // Initialize the shutdown coordinator
@@ -69,6 +80,15 @@ bool is_shutdown_initiated(void);
 // Returns true if all components stopped, false if timeout
 bool wait_for_all_components_stopped(int timeout_seconds);
 
+// Get a deadline timeout_ms from now, for waiting on several tiers in turn
+void get_shutdown_deadline(int timeout_ms, struct timespec *deadline);
+
+// Wait until every component with at least min_priority has stopped, or the
+// deadline (from get_shutdown_deadline) has passed. Stragglers are logged
+// every second and once more at the deadline, but left in their state.
+// Returns true if all of them stopped
+bool wait_for_components_stopped(int min_priority, const struct timespec *deadline);
+
 // Get the global shutdown coordinator instance
 shutdown_coordinator_t *get_shutdown_coordinator(void);
 
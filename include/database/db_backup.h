@@ -1,8 +1,43 @@
 #ifndef LIGHTNVR_DB_BACKUP_H
 #define LIGHTNVR_DB_BACKUP_H
 
+#include <stdbool.h>
+#include <time.h>
+
+typedef enum {
+    DB_BACKUP_IDLE = 0,
+    DB_BACKUP_COPYING,
+    DB_BACKUP_COMPRESSING,
+    DB_BACKUP_DONE,
+    DB_BACKUP_FAILED,
+    DB_BACKUP_ABORTED           // Stopped by shutdown
+} db_backup_state_t;
+
+typedef struct {
+    db_backup_state_t state;
+    time_t started_at;
+    time_t finished_at;
+    int pages_done;
+    int pages_total;
+    bool compressed;
+    long long size;             // Size of the finished backup file
+    char path[512];             // Backup file, with .gz once compressed
+    char message[128];          // Why the backup did not finish
+} db_backup_status_t;
+
+/**
+ * Called with the status of the background backup as it progresses
+ * Runs on the backup thread, at most every half second and on every change
+ * of state.
+ */
+typedef void (*db_backup_progress_fn)(const db_backup_status_t *status);
+
 /**
  * Backup the database to a specified path
+ *
+ * Copies one snapshot of the database in page batches without pausing, for
+ * startup and shutdown when nothing competes for the disk. The previous
+ * backup is only replaced once the copy is complete.
  * 
  * @param source_path Path to the source database file
  * @param dest_path Path to the destination backup file
@@ -10,6 +45,44 @@
  */
 int backup_database(const char *source_path, const char *dest_path);
 
+/**
+ * Start a backup of the database on a background thread
+ *
+ * The copy pauses after every few megabytes, so a backup of a large database
+ * takes longer but leaves the disk and the WAL to recording. In WAL mode
+ * writers are never blocked by it.
+ *
+ * @param source_path Path to the source database file
+ * @param dest_path Path to the destination backup file
+ * @param compress Gzip the backup to dest_path.gz, if built with zlib
+ * @return 0 if started, 1 if a backup is already running, -1 on error
+ */
+int start_database_backup(const char *source_path, const char *dest_path, bool compress);
+
+/**
+ * Stop the background backup, leaving the previous backup in place
+ */
+void stop_database_backup(void);
+
+/**
+ * Get the status of the last background backup
+ *
+ * @param status Receives the status
+ */
+void get_backup_status(db_backup_status_t *status);
+
+/**
+ * Set the function the background backup reports progress to
+ *
+ * @param fn Function, or NULL for none
+ */
+void set_backup_progress_callback(db_backup_progress_fn fn);
+
+/**
+ * Get the name of a backup state, as reported by the API
+ */
+const char *backup_state_name(db_backup_state_t state);
+
 /**
  * Restore database from backup
  * 
@@ -0,0 +1,46 @@
+/**
+ * Recordings compacted into shared files
+ *
+ * The compaction worker copies short clips of a stream into one container
+ * file per run and points their recordings at it. Each recording keeps its
+ * own row, times and ID, and gains its place in the container, so listings,
+ * timelines and search see no difference. Its size becomes its share of the
+ * container. The container is queued for deletion with its last recording.
+ */
+
+#ifndef LIGHTNVR_DB_COMPACTION_H
+#define LIGHTNVR_DB_COMPACTION_H
+
+#include <stdint.h>
+
+// Place of a recording in a container
+typedef struct {
+    uint64_t recording_id;
+    char source_path[256];      // File the recording had
+    int64_t offset_ms;          // Where it starts in the container
+    int64_t duration_ms;
+    uint64_t size_bytes;        // Its share of the container
+} compacted_recording_t;
+
+/**
+ * Point recordings at the container they were copied into, in one transaction
+ * A recording whose file_path is no longer its source_path, because it was
+ * deleted or moved while it was copied, leaves all of them as they were.
+ *
+ * @param container Path of the container
+ * @param recordings Recordings in the container
+ * @param count Number of recordings
+ * @return 0 on success, 1 if a recording changed meanwhile, -1 on error
+ */
+int compact_recordings(const char *container, const compacted_recording_t *recordings, int count);
+
+/**
+ * Get the place of a recording in its container
+ *
+ * @param recording_id Recording ID
+ * @param compacted Receives the place; may be NULL to only check
+ * @return 1 if the recording is compacted, 0 if it has its own file, -1 on error
+ */
+int get_recording_compaction(uint64_t recording_id, compacted_recording_t *compacted);
+
+#endif /* LIGHTNVR_DB_COMPACTION_H */
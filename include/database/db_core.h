@@ -1,6 +1,8 @@
 #ifndef LIGHTNVR_DB_CORE_H
 #define LIGHTNVR_DB_CORE_H
 
+#include <stddef.h>
+#include <stdint.h>
 #include <sqlite3.h>
 #include <pthread.h>
 
@@ -9,6 +11,65 @@
 #include "database/db_maintenance.h"
 #include "database/db_backup.h"
 
+/**
+ * Queries with a cached prepared statement
+ * Each ID is prepared once per connection and reused, see get_cached_stmt().
+ */
+typedef enum {
+    DB_STMT_RECORDING_INSERT,
+    DB_STMT_RECORDING_UPDATE,
+    DB_STMT_RECORDING_BY_ID,
+    DB_STMT_RECORDING_DELETE,
+    DB_STMT_RECORDING_SIZE,
+    DB_STMT_RECORDING_SEGMENT_INSERT,
+    DB_STMT_STREAM_BY_NAME,
+    DB_STMT_STREAM_ELIGIBLE,
+    DB_STMT_STREAM_ENABLED_COUNT,
+    DB_STMT_STREAM_COUNT,
+    DB_STMT_DETECTION_INSERT,
+    DB_STMT_DETECTION_RANGE,
+    DB_STMT_DETECTION_ACTIVITY_ADD,
+    DB_STMT_STREAM_ID_ADD,
+    DB_STMT_DETECTION_SEARCH,
+    DB_STMT_DETECTION_RECORDING,
+    DB_STMT_USER_BY_ID,
+    DB_STMT_USER_BY_USERNAME,
+    DB_STMT_USER_BY_API_KEY,
+    DB_STMT_SESSION_VALIDATE,
+    DB_STMT_COUNT
+} db_stmt_id_t;
+
+/**
+ * Groups of tables whose changes are counted, see get_table_version()
+ */
+typedef enum {
+    DB_TABLE_STREAMS,
+    DB_TABLE_RECORDINGS,
+    DB_TABLE_DETECTIONS,
+    DB_TABLE_EVENTS,
+    DB_TABLE_USERS,
+    DB_TABLE_OTHER,
+    DB_TABLE_COUNT
+} db_table_t;
+
+/**
+ * Statement cache counters
+ */
+typedef struct {
+    unsigned long prepares;     // Statements compiled by SQLite
+    unsigned long hits;         // Uses served by an already prepared statement
+    int cached;                 // Statements currently held
+} db_stmt_cache_stats_t;
+
+/**
+ * Set the page cache and memory map of the connections opened from then on
+ * The writer gets the whole cache, each read-only connection a quarter.
+ *
+ * @param cache_kb Page cache of the writer in KiB (0 = SQLite default)
+ * @param mmap_mb Memory-mapped I/O in MiB (0 = off)
+ */
+void set_database_sizes(int cache_kb, int mmap_mb);
+
 /**
  * Initialize the database
  * 
@@ -36,9 +97,93 @@ sqlite3 *get_db_handle(void);
  */
 pthread_mutex_t *get_db_mutex(void);
 
+/**
+ * Lock the database mutex, recording the wait in lightnvr_db_lock_wait_seconds
+ * Unlock it with pthread_mutex_unlock(get_db_mutex()).
+ */
+void lock_db_mutex(void);
+
+/**
+ * Get a connection for read-only queries
+ * In WAL mode this is one of a small pool of read-only connections, so long
+ * queries do not hold up writes; otherwise it is the main connection with
+ * the database mutex held. Blocks while all readers are busy. Must be handed
+ * back with release_db_reader(), and must not be nested.
+ *
+ * @return Connection, or NULL if the database is not open
+ */
+sqlite3 *acquire_db_reader(void);
+
+/**
+ * Hand back a connection from acquire_db_reader()
+ *
+ * @param reader Connection, may be NULL
+ */
+void release_db_reader(sqlite3 *reader);
+
+/**
+ * Get the cached statement for a query
+ * The statement is prepared on first use, or again when sql differs from
+ * the text it was prepared from (e.g. after a migration added columns).
+ * It is returned reset with no bindings. Must be called with the database
+ * mutex held, and the statement must be handed back with release_cached_stmt()
+ * before the mutex is released. Never finalize it.
+ *
+ * @param id Query ID
+ * @param sql Query text
+ * @return Statement, or NULL if it could not be prepared
+ */
+sqlite3_stmt *get_cached_stmt(db_stmt_id_t id, const char *sql);
+
+/**
+ * Get the cached statement for a query on a connection from acquire_db_reader()
+ * Each reader has its own statements; otherwise as get_cached_stmt().
+ *
+ * @param reader Connection from acquire_db_reader()
+ * @param id Query ID
+ * @param sql Query text
+ * @return Statement, or NULL if it could not be prepared
+ */
+sqlite3_stmt *get_reader_cached_stmt(sqlite3 *reader, db_stmt_id_t id, const char *sql);
+
+/**
+ * Hand back a cached statement, resetting it so it holds no read transaction
+ *
+ * @param stmt Statement from get_cached_stmt(), may be NULL
+ */
+void release_cached_stmt(sqlite3_stmt *stmt);
+
+/**
+ * Get the statement cache counters
+ *
+ * @param stats Receives the counters
+ */
+void get_stmt_cache_stats(db_stmt_cache_stats_t *stats);
+
+/**
+ * Get the memory SQLite has allocated, over all connections
+ * Includes the page caches and prepared statements.
+ *
+ * @return Bytes in use
+ */
+size_t get_database_memory_usage(void);
+
+/**
+ * Get a counter that increases with every commit changing a group of tables
+ * It is bumped once the commit is visible to readers, so anything read after
+ * getting the version is at least as new as the version. Partitions and
+ * helper tables count as their table, e.g. detection_blocks as detections.
+ * Starts at 0 with every process.
+ *
+ * @param table Table group
+ * @return Version of the group
+ */
+uint64_t get_table_version(db_table_t table);
+
 /**
  * Checkpoint the database WAL file
- * This ensures all changes are written to the main database file
+ * This ensures all changes are written to the main database file.
+ * Routine checkpoints run in the background after commits.
  * 
  * @return 0 on success, non-zero on failure
  */
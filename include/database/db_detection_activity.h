@@ -0,0 +1,82 @@
+/**
+ * Per-minute detection activity
+ *
+ * detection_activity holds per stream, minute and label the number of
+ * detections and their highest confidence. Motion detections are stored
+ * with the label "motion" and their score as confidence, so the motion row
+ * of a minute carries its highest motion score. The detection writer adds
+ * to it in the transaction of every batch, whichever way the detections
+ * themselves are stored, and retention deletes it with the detections.
+ *
+ * Timelines read activity from it at any zoom level instead of scanning
+ * detections: a week of one stream is at most a row per minute and label
+ * seen, and only minutes with detections have rows.
+ */
+
+#ifndef LIGHTNVR_DB_DETECTION_ACTIVITY_H
+#define LIGHTNVR_DB_DETECTION_ACTIVITY_H
+
+#include <time.h>
+#include <sqlite3.h>
+#include "video/detection_result.h"
+
+// Label of motion detections, whose confidence is the motion score
+#define ACTIVITY_MOTION_LABEL "motion"
+
+// Labels reported per bucket, the most frequent ones first
+#define ACTIVITY_MAX_LABELS 8
+
+typedef struct {
+    char label[MAX_LABEL_LENGTH];
+    int count;
+    float max_confidence;
+} activity_label_t;
+
+typedef struct {
+    time_t start;                   // Start of the bucket
+    int count;                      // Detections of all labels
+    float motion;                   // Highest motion score, 0 without motion
+    int label_count;
+    activity_label_t labels[ACTIVITY_MAX_LABELS];
+} activity_bucket_t;
+
+/**
+ * Add detections of one stream to their minutes
+ * Must be called with the database mutex held, within the transaction
+ * storing the detections.
+ *
+ * @param db Database handle
+ * @param stream_name Stream name
+ * @param timestamps Time of each detection
+ * @param detections Detections
+ * @param count Number of detections
+ * @return 0 on success, -1 on error
+ */
+int add_detection_activity(sqlite3 *db, const char *stream_name, const time_t *timestamps,
+                           const detection_t *detections, int count);
+
+/**
+ * Get detection activity in buckets of whole minutes
+ * Only buckets with detections are returned.
+ *
+ * @param stream_name Stream name, or NULL for all streams
+ * @param start_time Start of the first bucket, rounded down to a minute
+ * @param end_time End of the range, exclusive
+ * @param bucket_seconds Length of a bucket, a multiple of 60
+ * @param buckets Receives the buckets oldest first, to release with free()
+ * @return Number of buckets, or -1 on error
+ */
+int get_detection_activity(const char *stream_name, time_t start_time, time_t end_time,
+                           int bucket_seconds, activity_bucket_t **buckets);
+
+/**
+ * Delete activity of minutes that ended before a time
+ * Must be called with the database mutex held.
+ *
+ * @param db Database handle
+ * @param cutoff_time Minutes ending before this are deleted
+ * @return Number of rows deleted, or -1 on error
+ */
+int delete_detection_activity_before(sqlite3 *db, time_t cutoff_time);
+
+#endif // LIGHTNVR_DB_DETECTION_ACTIVITY_H
@@ -0,0 +1,88 @@
+/**
+ * Compact detection storage
+ *
+ * With [database] compact_detections, detections are kept as one blob per
+ * stream and minute in detection_blocks instead of one detections row each.
+ * A blob is a sequence of 16-byte little-endian records:
+ *
+ *   offset  size  field
+ *   0       1     second within the minute (0-59)
+ *   1       1     label ID, see detection_labels
+ *   2       1     confidence, 0-255 for 0.0-1.0
+ *   3       1     reserved, 0
+ *   4       8     x, y, width, height, uint16 each, 0-65535 for 0.0-1.0
+ *   12      4     track ID
+ *
+ * detection_summary holds per stream, minute and label the number of
+ * detections and the highest confidence, so label and time queries use
+ * an index instead of decoding blobs. Retention deletes whole minutes.
+ *
+ * Writes and deletes must be called with the database mutex held; reads
+ * may also run on a connection from acquire_db_reader().
+ */
+
+#ifndef LIGHTNVR_DB_DETECTION_BLOCKS_H
+#define LIGHTNVR_DB_DETECTION_BLOCKS_H
+
+#include <stdbool.h>
+#include <time.h>
+#include <sqlite3.h>
+#include "video/detection_result.h"
+
+// Size of one encoded detection
+#define DETECTION_RECORD_SIZE 16
+
+/**
+ * Append detections of one stream to their minute blocks
+ * Detections whose label does not fit the 255-entry dictionary are left
+ * for the caller to store as rows.
+ *
+ * @param db Database handle
+ * @param stream_name Stream name
+ * @param timestamps Time of each detection
+ * @param detections Detections
+ * @param count Number of detections
+ * @param stored Receives for each detection whether it was stored
+ * @return 0 on success, -1 on error
+ */
+int store_detection_blocks(sqlite3 *db, const char *stream_name, const time_t *timestamps,
+                           const detection_t *detections, int count, bool *stored);
+
+/**
+ * Read the newest detections of a stream from its minute blocks
+ *
+ * @param db Database handle
+ * @param stream_name Stream name
+ * @param start_time Oldest time to include (0 for no limit)
+ * @param end_time Newest time to include (0 for no limit)
+ * @param detections Receives the detections, newest first
+ * @param timestamps Receives the time of each detection
+ * @param max_count Capacity of detections and timestamps
+ * @return Number of detections, or -1 on error
+ */
+int load_detection_blocks(sqlite3 *db, const char *stream_name, time_t start_time, time_t end_time,
+                          detection_t *detections, time_t *timestamps, int max_count);
+
+/**
+ * Delete blocks and summaries of minutes that ended before a time
+ *
+ * @param db Database handle
+ * @param cutoff_time Minutes ending before this are deleted
+ * @return Number of detections deleted, or -1 on error
+ */
+int delete_detection_blocks_before(sqlite3 *db, time_t cutoff_time);
+
+/**
+ * Get the highest track ID among the latest blocks
+ *
+ * @param db Database handle
+ * @return Highest track ID, 0 if none, -1 on error
+ */
+int get_detection_blocks_max_track_id(sqlite3 *db);
+
+/**
+ * Forget the cached label dictionary, e.g. when the database is closed
+ */
+void reset_detection_labels(void);
+
+#endif // LIGHTNVR_DB_DETECTION_BLOCKS_H
@@ -0,0 +1,70 @@
+/**
+ * Detection search
+ *
+ * Finds the detections of a label across streams, newest first. Rows of the
+ * detections table carry the ID of their label from detection_labels and
+ * are found through their (label_id, timestamp) index. Day partitions and
+ * compact blocks are not searched row by row: detection_activity (see
+ * db_detection_activity.h) and detection_summary name the minutes of each
+ * stream holding the label, and only those minutes are read.
+ *
+ * Results are paged with a cursor of the time of the last result and the
+ * number of results of that second already returned, so a page costs the
+ * same however deep into the results it is.
+ */
+
+#ifndef LIGHTNVR_DB_DETECTION_SEARCH_H
+#define LIGHTNVR_DB_DETECTION_SEARCH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include "core/config.h"
+#include "video/detection_result.h"
+
+#define LABEL_ID_OF(label) "(SELECT id FROM detection_labels WHERE label = " label ")"
+
+// Trigger giving rows of a table inserted without a label_id their ID
+#define LABEL_ID_TRIGGER_SQL(table) \
+    "CREATE TRIGGER IF NOT EXISTS " table "_label_id AFTER INSERT ON " table " " \
+    "WHEN NEW.label_id IS NULL BEGIN " \
+    "INSERT OR IGNORE INTO detection_labels (label) VALUES (NEW.label); " \
+    "UPDATE " table " SET label_id = " LABEL_ID_OF("NEW.label") " WHERE id = NEW.id; " \
+    "END;"
+
+// Results returned per page at most
+#define DETECTION_SEARCH_MAX_RESULTS 500
+
+typedef struct {
+    const char *label;
+    const char *streams;            // Comma-separated stream names, NULL for all
+    time_t start_time;
+    time_t end_time;
+    float min_confidence;
+    int limit;                      // Results per page
+    time_t cursor_time;             // Time of the last result of the previous page, 0 for the first
+    int cursor_skip;                // Results at cursor_time already returned
+} detection_search_query_t;
+
+typedef struct {
+    char stream_name[MAX_STREAM_NAME];
+    time_t timestamp;
+    detection_t detection;
+    uint64_t recording_id;          // Recording covering the detection, 0 if none
+    time_t recording_start;
+} detection_search_result_t;
+
+/**
+ * Search detections of a label, newest first
+ *
+ * @param query Search parameters
+ * @param results Receives up to query->limit results
+ * @param next_time Receives the cursor time of the next page
+ * @param next_skip Receives the cursor skip of the next page
+ * @param more Receives whether there are more results
+ * @return Number of results, or -1 on error
+ */
+int search_detections(const detection_search_query_t *query, detection_search_result_t *results,
+                      time_t *next_time, int *next_skip, bool *more);
+
+#endif // LIGHTNVR_DB_DETECTION_SEARCH_H
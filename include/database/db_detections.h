@@ -5,16 +5,41 @@
 #include <time.h>
 #include "video/detection_result.h"
 
+/**
+ * Start the detection writer thread
+ * Called by init_database; from then on stored detections are queued and
+ * written in batches from all streams in one transaction.
+ * 
+ * @return 0 on success, non-zero on failure
+ */
+int init_detection_writer(void);
+
+/**
+ * Stop the detection writer thread after writing what is still queued
+ */
+void shutdown_detection_writer(void);
+
 /**
  * Store detection results in the database
+ * Queues the detections for the writer thread and returns without waiting
+ * for SQLite; they are written directly if the writer is not running.
  * 
  * @param stream_name Stream name
  * @param result Detection results
  * @param timestamp Timestamp of the detection (0 for current time)
- * @return 0 on success, non-zero on failure
+ * @return 0 on success (queued), non-zero on failure
  */
 int store_detections_in_db(const char *stream_name, const detection_result_t *result, time_t timestamp);
 
+/**
+ * Get the number of detections stored and dropped since start
+ * Detections are dropped when the write queue is full.
+ *
+ * @param written Receives the detections written to the database (may be NULL)
+ * @param dropped Receives the detections dropped (may be NULL)
+ */
+void get_detection_writer_stats(uint64_t *written, uint64_t *dropped);
+
 /**
  * Get detection results from the database with time range filtering
  * 
@@ -60,4 +85,11 @@ int get_detections_from_db(const char *stream_name, detection_result_t *result,
  */
 int delete_old_detections(uint64_t max_age);
 
+/**
+ * Get the highest track ID stored in the database
+ * 
+ * @return Highest track ID among the latest detections, 0 if none, -1 on error
+ */
+int get_max_detection_track_id(void);
+
 #endif // LIGHTNVR_DB_DETECTIONS_H
@@ -18,7 +18,8 @@ typedef enum {
     EVENT_USER_LOGIN,
     EVENT_USER_LOGOUT,
     EVENT_CONFIG_CHANGE,
-    EVENT_CUSTOM
+    EVENT_CUSTOM,
+    EVENT_STORAGE_SLOW          // Added after EVENT_CUSTOM, the stored values stay as they were
 } event_type_t;
 
 // Event information structure
@@ -43,6 +44,19 @@ typedef struct {
 uint64_t add_event(event_type_t type, const char *stream_name, 
                   const char *description, const char *details);
 
+/**
+ * Add an event that happened at a given time
+ * 
+ * @param type Event type
+ * @param timestamp When the event happened
+ * @param stream_name Stream name (can be NULL for system events)
+ * @param description Short description of the event
+ * @param details Detailed information about the event (can be NULL)
+ * @return Event ID on success, 0 on failure
+ */
+uint64_t add_event_at(event_type_t type, time_t timestamp, const char *stream_name,
+                      const char *description, const char *details);
+
 /**
  * Get events from the database
  * 
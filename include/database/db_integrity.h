@@ -0,0 +1,83 @@
+/**
+ * Database integrity verification
+ *
+ * A full integrity check reads every page and index of the database, which
+ * takes minutes on a large one. Startup therefore only checks the file header,
+ * the WAL header and the schema, which takes constant time, so recording can
+ * start right away.
+ *
+ * The full check runs later on its own read-only connection, one table with
+ * its indexes at a time. It pauses between tables and every few thousand
+ * steps within a table, so it never holds a read snapshot for long or
+ * competes with recording for disk bandwidth. The database is only repaired
+ * if the full check finds a problem.
+ */
+
+#ifndef LIGHTNVR_DB_INTEGRITY_H
+#define LIGHTNVR_DB_INTEGRITY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+#include <sqlite3.h>
+
+typedef enum {
+    DB_INTEGRITY_IDLE = 0,      // Not started, e.g. for a new database
+    DB_INTEGRITY_PENDING,       // Waiting for startup to settle
+    DB_INTEGRITY_RUNNING,
+    DB_INTEGRITY_PASSED,
+    DB_INTEGRITY_FAILED,
+    DB_INTEGRITY_ABORTED        // Stopped by shutdown or an error of the check itself
+} db_integrity_state_t;
+
+typedef struct {
+    db_integrity_state_t state;
+    time_t started_at;
+    time_t finished_at;
+    int tables_checked;
+    int tables_total;
+    int errors;                 // Problems reported by SQLite
+    bool repair_attempted;
+    bool repaired;
+    char message[256];          // First problem found, or why the check was aborted
+} db_integrity_status_t;
+
+/**
+ * Check the database file header, WAL header and schema
+ * Takes constant time regardless of the size of the database.
+ *
+ * @param conn Connection to the database, read-only is enough
+ * @param db_path Path of the database file
+ * @param msg Buffer receiving the problem found
+ * @param size Size of the buffer
+ * @return 0 if the database looks sound, -1 otherwise
+ */
+int database_fast_check(sqlite3 *conn, const char *db_path, char *msg, size_t size);
+
+/**
+ * Start the full integrity check in the background
+ *
+ * @param db_path Path of the database file
+ * @param delay_sec Seconds to wait before the check starts
+ * @return 0 on success, -1 on error
+ */
+int start_integrity_check(const char *db_path, int delay_sec);
+
+/**
+ * Stop the background integrity check, aborting it if it is running
+ */
+void stop_integrity_check(void);
+
+/**
+ * Get the state of the background integrity check
+ *
+ * @param status Receives the status
+ */
+void get_integrity_status(db_integrity_status_t *status);
+
+/**
+ * Get the name of an integrity check state, as reported by the API
+ */
+const char *integrity_state_name(db_integrity_state_t state);
+
+#endif // LIGHTNVR_DB_INTEGRITY_H
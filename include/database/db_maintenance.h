@@ -2,6 +2,10 @@
 #define LIGHTNVR_DB_MAINTENANCE_H
 
 #include <stdint.h>
+#include <time.h>
+
+// Rows deleted per transaction by retention
+#define RETENTION_BATCH_ROWS 1000
 
 /**
  * Get the database size
@@ -17,6 +21,28 @@ int64_t get_database_size(void);
  */
 int vacuum_database(void);
 
+/**
+ * Delete rows older than a cutoff in bounded batches
+ * Each batch is its own transaction and the database mutex is released
+ * between batches, so retention never holds the database for long.
+ *
+ * @param sql DELETE statement with the cutoff as first and the batch size
+ *            as second parameter, e.g. "DELETE FROM t WHERE id IN
+ *            (SELECT id FROM t WHERE timestamp < ? LIMIT ?);"
+ * @param cutoff_time Rows older than this are deleted
+ * @return Number of rows deleted, or -1 if nothing could be deleted
+ */
+int delete_rows_in_batches(const char *sql, time_t cutoff_time);
+
+/**
+ * Return free pages to the file system a few at a time
+ * Needs auto_vacuum=INCREMENTAL, otherwise nothing is freed.
+ *
+ * @param max_pages Most pages to free in this call
+ * @return Number of pages freed, or -1 on error
+ */
+int incremental_vacuum_database(int max_pages);
+
 /**
  * Check database integrity
  * 
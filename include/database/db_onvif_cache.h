@@ -0,0 +1,64 @@
+/**
+ * Cache of ONVIF device capabilities
+ *
+ * Keeps per device service URL the firmware version, the media service URL
+ * and the media profiles with their stream URIs, so adding or testing a
+ * camera does not repeat GetServices, GetProfiles and GetStreamUri. Stream
+ * URIs are stored as the device reports them, without credentials.
+ */
+
+#ifndef LIGHTNVR_DB_ONVIF_CACHE_H
+#define LIGHTNVR_DB_ONVIF_CACHE_H
+
+#include <time.h>
+#include "video/onvif_discovery.h"
+
+// Cached device information
+typedef struct {
+    char firmware_version[64];
+    char media_url[MAX_URL_LENGTH];
+    time_t updated_at;
+} onvif_cache_info_t;
+
+/**
+ * Get the cached capabilities of a device
+ *
+ * @param device_url Device service URL
+ * @param info Receives the device information
+ * @param profiles Receives the profiles, in the order the device reported them
+ * @param max_profiles Capacity of profiles
+ * @return Number of profiles, or -1 if the device is not cached or on error
+ */
+int get_onvif_cache(const char *device_url, onvif_cache_info_t *info,
+                    onvif_profile_t *profiles, int max_profiles);
+
+/**
+ * Replace the cached capabilities of a device
+ *
+ * @param device_url Device service URL
+ * @param info Device information
+ * @param profiles Profiles
+ * @param count Number of profiles
+ * @return 0 on success, -1 on error
+ */
+int store_onvif_cache(const char *device_url, const onvif_cache_info_t *info,
+                      const onvif_profile_t *profiles, int count);
+
+/**
+ * Mark the cached capabilities of a device as current
+ *
+ * @param device_url Device service URL
+ * @param updated_at Time the device was last checked
+ * @return 0 on success, -1 on error
+ */
+int touch_onvif_cache(const char *device_url, time_t updated_at);
+
+/**
+ * Forget the cached capabilities of a device
+ *
+ * @param device_url Device service URL
+ * @return 0 on success, -1 on error
+ */
+int delete_onvif_cache(const char *device_url);
+
+#endif /* LIGHTNVR_DB_ONVIF_CACHE_H */
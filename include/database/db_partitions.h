@@ -0,0 +1,89 @@
+/**
+ * Day-partitioned tables
+ *
+ * With [database] partition_by_day, new detections and events go to one
+ * table per UTC day, named like detections_20260115, next to the original
+ * table. Retention then drops whole tables instead of deleting rows, which
+ * takes the same time however many rows a day holds and frees the pages
+ * right away. Readers query the original table and the partitions of the
+ * days they cover. Partitions index their rows by stream name rather than
+ * stream ID (see db_streams.h); holding one day each, they stay small.
+ *
+ * Creating and dropping partitions must be done with the database mutex
+ * held; listing may also run on a connection from acquire_db_reader().
+ */
+
+#ifndef LIGHTNVR_DB_PARTITIONS_H
+#define LIGHTNVR_DB_PARTITIONS_H
+
+#include <stddef.h>
+#include <time.h>
+#include <sqlite3.h>
+
+// Longest partition name, e.g. "detections_20260115"
+#define MAX_PARTITION_NAME 64
+
+// Most partitions a single query reads; older days are left out
+#define MAX_QUERY_PARTITIONS 64
+
+/**
+ * Get the partition day of a time
+ *
+ * @param t Time
+ * @return Days since the epoch in UTC
+ */
+int partition_day(time_t t);
+
+/**
+ * Get the name of a partition
+ *
+ * @param base Name of the original table
+ * @param day Partition day
+ * @param name Buffer for the name
+ * @param name_size Size of the buffer
+ */
+void partition_name(const char *base, int day, char *name, size_t name_size);
+
+/**
+ * Create the partition of a day if it does not exist yet
+ *
+ * @param db Database handle
+ * @param base Name of the original table
+ * @param day Partition day
+ * @param columns Column definitions, without parentheses
+ * @param index_columns Columns of the partition's index, without parentheses
+ * @return 0 on success, -1 on error
+ */
+int ensure_partition(sqlite3 *db, const char *base, int day, const char *columns,
+                     const char *index_columns);
+
+/**
+ * List the partitions of a table in a range of days
+ *
+ * @param db Database handle
+ * @param base Name of the original table
+ * @param first_day Oldest day to include
+ * @param last_day Newest day to include
+ * @param days Receives the days that have a partition, newest first
+ * @param max_days Capacity of days
+ * @return Number of partitions, or -1 on error
+ */
+int list_partitions(sqlite3 *db, const char *base, int first_day, int last_day,
+                    int *days, int max_days);
+
+/**
+ * Drop the partitions of a table older than a day
+ *
+ * @param db Database handle
+ * @param base Name of the original table
+ * @param day Partitions of days before this are dropped
+ * @return Number of partitions dropped, or -1 on error
+ */
+int drop_partitions_before(sqlite3 *db, const char *base, int day);
+
+/**
+ * Forget which partitions are known to exist, e.g. when the database is closed
+ */
+void reset_partition_cache(void);
+
+#endif // LIGHTNVR_DB_PARTITIONS_H
@@ -0,0 +1,115 @@
+/**
+ * Per-stream recording usage
+ *
+ * Bytes, number and time span of the recordings of each stream, kept up to
+ * date as recordings are added, finalized and deleted, so storage totals
+ * cost one lookup per stream instead of a walk over every file.
+ * reconcile_recording_usage() rebuilds the totals from the recordings
+ * table, at startup and now and then to correct any drift.
+ *
+ * Every update is also logged with the time span it touched, so caches of
+ * recording lists can tell whether a cached range is still current; see
+ * recordings_changed_since().
+ *
+ * The update functions are called by db_recordings.c with the database
+ * mutex held.
+ */
+
+#ifndef LIGHTNVR_DB_RECORDING_USAGE_H
+#define LIGHTNVR_DB_RECORDING_USAGE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+// Streams with recordings, including deleted streams whose recordings remain
+#define MAX_USAGE_STREAMS 128
+
+// Usage of one stream, or of all streams together
+typedef struct {
+    char stream_name[64];
+    uint64_t size_bytes;
+    int recording_count;
+    time_t oldest_time;      // Start of the oldest recording, 0 if none
+    time_t newest_time;      // End of the newest recording, 0 if none
+} recording_usage_t;
+
+/**
+ * Count a new recording
+ *
+ * @param stream_name Stream name
+ * @param size_bytes Size of the recording so far
+ * @param start_time Start of the recording
+ * @param end_time End of the recording, or 0 if still recording
+ */
+void recording_usage_add(const char *stream_name, uint64_t size_bytes, time_t start_time, time_t end_time);
+
+/**
+ * Account for a recording that grew or was finalized
+ *
+ * @param stream_name Stream name
+ * @param size_delta Change of the recording's size in bytes
+ * @param start_time Start of the recording
+ * @param end_time New end of the recording
+ */
+void recording_usage_resize(const char *stream_name, int64_t size_delta, time_t start_time, time_t end_time);
+
+/**
+ * Account for deleted recordings
+ * The oldest time of the stream is looked up again on the next read.
+ *
+ * @param stream_name Stream name
+ * @param count Number of recordings deleted
+ * @param size_bytes Their total size
+ * @param start_time Earliest start of the deleted recordings (0 if unknown)
+ * @param end_time Latest end of the deleted recordings
+ */
+void recording_usage_remove(const char *stream_name, int count, uint64_t size_bytes,
+                            time_t start_time, time_t end_time);
+
+/**
+ * Rebuild the usage of all streams from the recordings table
+ * Takes the database mutex for one aggregate query.
+ *
+ * @return Number of streams, or -1 on error
+ */
+int reconcile_recording_usage(void);
+
+/**
+ * Get the usage of each stream
+ *
+ * @param usage Receives the usage, one entry per stream
+ * @param max_streams Capacity of usage
+ * @return Number of streams, or -1 if the usage was never reconciled
+ */
+int get_recording_usage(recording_usage_t *usage, int max_streams);
+
+/**
+ * Get the usage of all streams together
+ *
+ * @param totals Receives the totals; stream_name is empty
+ * @return 0 on success, -1 if the usage was never reconciled
+ */
+int get_recording_usage_totals(recording_usage_t *totals);
+
+/**
+ * Get the sequence number of the latest change to any recording
+ *
+ * @return Sequence number, to pass to recordings_changed_since() later
+ */
+uint64_t get_recording_change_seq(void);
+
+/**
+ * Check whether recordings of a stream within a time span changed
+ * Answers true when the change log no longer reaches back far enough.
+ *
+ * @param seq Sequence number from get_recording_change_seq()
+ * @param stream_name Stream name
+ * @param start_time Start of the span
+ * @param end_time End of the span
+ * @return true if a recording overlapping the span was added, changed or
+ *         deleted after seq
+ */
+bool recordings_changed_since(uint64_t seq, const char *stream_name, time_t start_time, time_t end_time);
+
+#endif // LIGHTNVR_DB_RECORDING_USAGE_H
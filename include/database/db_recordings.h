@@ -20,6 +20,24 @@ typedef struct {
     bool is_complete;
 } recording_metadata_t;
 
+// Position in a listing ordered by start_time, for keyset pagination
+typedef struct {
+    time_t start_time;
+    uint64_t id;
+} recording_cursor_t;
+
+// Longest cursor token, with its terminating NUL
+#define RECORDING_CURSOR_SIZE 34
+
+// Span of a complete recording, for timelines
+typedef struct {
+    uint64_t id;
+    char stream_name[64];
+    time_t start_time;
+    time_t end_time;
+    uint64_t size_bytes;
+} recording_span_t;
+
 /**
  * Add recording metadata to the database
  * 
@@ -28,8 +46,36 @@ typedef struct {
  */
 uint64_t add_recording_metadata(const recording_metadata_t *metadata);
 
+/**
+ * Add recordings to the database in one transaction
+ * 
+ * @param metadata Recordings to add
+ * @param count Number of recordings
+ * @return Number of recordings added, or -1 on failure (none are added)
+ */
+int add_recording_metadata_batch(const recording_metadata_t *metadata, int count);
+
+/**
+ * Start the recording update writer thread
+ * Called by init_database; from then on update_recording_metadata() keeps
+ * only the latest update of each recording and writes them all in one
+ * transaction every couple of seconds.
+ * 
+ * @return 0 on success, non-zero on failure
+ */
+int init_recording_update_writer(void);
+
+/**
+ * Stop the recording update writer thread after writing what is still pending
+ */
+void shutdown_recording_update_writer(void);
+
 /**
  * Update recording metadata in the database
+ * Updates of recordings still being written are queued for the writer
+ * thread, which keeps only the latest of each recording. Marking a
+ * recording complete flushes the queue and returns once it is written.
+ * Updates are written directly if the writer is not running.
  * 
  * @param id Recording ID
  * @param end_time New end time
@@ -40,6 +86,38 @@ uint64_t add_recording_metadata(const recording_metadata_t *metadata);
 int update_recording_metadata(uint64_t id, time_t end_time, 
                              uint64_t size_bytes, bool is_complete);
 
+/**
+ * Segment of a recording kept as HLS segments, see hls_recording.h
+ */
+typedef struct {
+    int sequence;           // Position in the recording, from 0
+    char file_name[64];     // In the directory of the recording's playlist
+    int64_t start_ms;       // From the start of the recording
+    int64_t duration_ms;
+    uint64_t size_bytes;
+} recording_segment_t;
+
+/**
+ * Add a segment to a recording kept as HLS segments
+ * The recording's end time and size grow with the segment, in the same
+ * transaction.
+ *
+ * @param recording_id Recording ID
+ * @param segment Segment to add
+ * @param end_time Wall clock time the segment ends at
+ * @return 0 on success, non-zero on failure
+ */
+int add_recording_segment(uint64_t recording_id, const recording_segment_t *segment, time_t end_time);
+
+/**
+ * Get the segments of a recording kept as HLS segments
+ *
+ * @param recording_id Recording ID
+ * @param segments Receives the segments in order, to free with free(); NULL if there are none
+ * @return Number of segments, or -1 on error
+ */
+int get_recording_segments(uint64_t recording_id, recording_segment_t **segments);
+
 /**
  * Get recording metadata from the database
  * 
@@ -56,6 +134,9 @@ int get_recording_metadata(time_t start_time, time_t end_time,
 
 /**
  * Get total count of recordings matching filter criteria
+ * Without a detection filter, whole days are taken from the per-day counts
+ * of recording_days and only the partial days at the edges of the range are
+ * counted row by row.
  * 
  * @param start_time Start time filter (0 for no filter)
  * @param end_time End time filter (0 for no filter)
@@ -86,6 +167,63 @@ int get_recording_metadata_paginated(time_t start_time, time_t end_time,
                                    recording_metadata_t *metadata, 
                                    int limit, int offset);
 
+/**
+ * Get the page of recordings that follows a cursor
+ * Recordings are ordered by start_time, then id, in sort_order. Pass the
+ * start_time and id of the last recording of the previous page as cursor;
+ * unlike an offset, this costs the same however deep the page is.
+ *
+ * @param start_time Start time filter (0 for no filter)
+ * @param end_time End time filter (0 for no filter)
+ * @param stream_name Stream name filter (NULL for all streams)
+ * @param has_detection Filter for recordings with detection events (0 for all)
+ * @param sort_order Sort order ("asc" or "desc")
+ * @param cursor Last recording of the previous page
+ * @param metadata Array to fill with recording metadata
+ * @param limit Maximum number of recordings to return
+ * @return Number of recordings found, or -1 on error
+ */
+int get_recording_metadata_after(time_t start_time, time_t end_time,
+                                 const char *stream_name, int has_detection,
+                                 const char *sort_order, const recording_cursor_t *cursor,
+                                 recording_metadata_t *metadata, int limit);
+
+/**
+ * Format a cursor as a token for clients
+ * Clients treat the token as opaque and only echo it back.
+ *
+ * @param cursor Cursor to format
+ * @param token Buffer for the token
+ * @param token_size Size of the buffer, RECORDING_CURSOR_SIZE is always enough
+ */
+void format_recording_cursor(const recording_cursor_t *cursor, char *token, size_t token_size);
+
+/**
+ * Parse a token from format_recording_cursor()
+ * Only accepts what it formats: two runs of 1-16 hex digits joined by a
+ * dot, with values that fit a signed 64-bit integer.
+ *
+ * @param token Token to parse
+ * @param cursor Receives the cursor, left unchanged on error
+ * @return 0 on success, -1 if the token is malformed
+ */
+int parse_recording_cursor(const char *token, recording_cursor_t *cursor);
+
+/**
+ * Get the spans of the complete recordings of several streams
+ * One query reads all streams from the (is_complete, stream_id, start_time)
+ * index; spans are ordered by stream ID, then start time.
+ *
+ * @param streams Comma-separated stream names
+ * @param start_time Recordings starting at or after this time
+ * @param end_time Recordings starting at or before this time
+ * @param max_spans Maximum number of spans to return
+ * @param spans Receives an array to free with free(), NULL if none are found
+ * @return Number of spans found, or -1 on error
+ */
+int get_recording_spans(const char *streams, time_t start_time, time_t end_time,
+                        int max_spans, recording_span_t **spans);
+
 /**
  * Get recording metadata by ID
  * 
@@ -95,6 +233,16 @@ int get_recording_metadata_paginated(time_t start_time, time_t end_time,
  */
 int get_recording_metadata_by_id(uint64_t id, recording_metadata_t *metadata);
 
+/**
+ * Get recordings that were never marked complete
+ * Only id, stream_name, file_path and start_time are filled in.
+ *
+ * @param metadata Array to fill with recording metadata
+ * @param max_count Maximum number of recordings to return
+ * @return Number of recordings found, or -1 on error
+ */
+int get_incomplete_recordings(recording_metadata_t *metadata, int max_count);
+
 /**
  * Delete recording metadata from the database
  * 
@@ -103,8 +251,94 @@ int get_recording_metadata_by_id(uint64_t id, recording_metadata_t *metadata);
  */
 int delete_recording_metadata(uint64_t id);
 
+/**
+ * Point a recording at a copy of its file
+ * The path is only changed if it is still old_path, so a recording deleted
+ * or changed while the copy was made is left alone. A compacted recording
+ * moves together with the others in its container (see db_compaction.h).
+ * 
+ * @param id Recording ID
+ * @param old_path Path the copy was made from
+ * @param new_path Path of the copy
+ * @return 0 if changed, 1 if the recording no longer has old_path, -1 on error
+ */
+int move_recording_file_path(uint64_t id, const char *old_path, const char *new_path);
+
+/**
+ * Mark a recording whose file was rewritten with only its key frames
+ * The recordings compacted into the same file are marked with it, and
+ * their sizes scaled to the new size of the file, in one transaction.
+ * 
+ * @param id Recording ID
+ * @param file_path Path of the rewritten file
+ * @param file_size New size of the file
+ * @return 0 if marked, 1 if the recording no longer has file_path, -1 on error
+ */
+int mark_recording_thinned(uint64_t id, const char *file_path, uint64_t file_size);
+
+// Recording file waiting to be unlinked by the deletion worker
+typedef struct {
+    int64_t id;
+    char file_path[256];
+} pending_file_deletion_t;
+
+/**
+ * Delete a recording's metadata and queue its file for deletion
+ * Both happen in one transaction, so the file is deleted even if the
+ * process dies before the deletion worker gets to it.
+ * 
+ * @param id Recording ID
+ * @return 0 on success, non-zero on failure
+ */
+int delete_recording_deferred(uint64_t id);
+
+/**
+ * Called while a batch of recordings is deleted
+ *
+ * @param done Number of IDs processed so far
+ * @param total Number of IDs in the batch
+ * @param opaque Value passed to the batch function
+ */
+typedef void (*recording_delete_progress_fn)(int done, int total, void *opaque);
+
+/**
+ * Delete many recordings' metadata and queue their files for deletion
+ * The IDs are looked up in chunks of a few hundred, and all rows are
+ * deleted in a single transaction, so either every found recording is
+ * deleted or none is.
+ *
+ * @param ids Recording IDs
+ * @param count Number of IDs
+ * @param deleted Receives whether each ID was deleted, false if it was not found; may be NULL
+ * @param progress Called after each chunk, from within the transaction; may be NULL
+ * @param opaque Passed to progress
+ * @return Number of recordings deleted, or -1 on error
+ */
+int delete_recordings_deferred(const uint64_t *ids, int count, bool *deleted,
+                               recording_delete_progress_fn progress, void *opaque);
+
+/**
+ * Get the oldest files waiting to be unlinked
+ * 
+ * @param pending Array to fill
+ * @param max_count Capacity of pending
+ * @return Number of files, or -1 on error
+ */
+int get_pending_file_deletions(pending_file_deletion_t *pending, int max_count);
+
+/**
+ * Remove files from the deletion queue once they are gone
+ * 
+ * @param ids IDs from get_pending_file_deletions()
+ * @param count Number of IDs
+ * @return 0 on success, non-zero on failure
+ */
+int remove_pending_file_deletions(const int64_t *ids, int count);
+
 /**
  * Delete old recording metadata from the database
+ * Recordings of streams with their own retention_days are left to the
+ * retention engine.
  * 
  * @param max_age Maximum age in seconds
  * @return Number of recordings deleted, or -1 on error
@@ -4,6 +4,33 @@
 #include <stdint.h>
 #include "core/config.h"
 
+/*
+ * Stream IDs
+ *
+ * recordings, detections and events keep the name of their stream for
+ * reading, but their indexes are built on an integer stream_id from the
+ * stream_ids table, which keeps them several times smaller than indexes on
+ * the names. IDs outlive the streams, since recordings may be kept after
+ * their stream is deleted, and are never reused.
+ *
+ * Writers may set stream_id with STREAM_ID_OF(); rows inserted without one
+ * get it from a trigger. Queries by name compare stream_id with
+ * STREAM_ID_OF() so they search the integer indexes:
+ *
+ *     "SELECT ... FROM recordings WHERE stream_id = " STREAM_ID_OF("?") " AND ..."
+ *
+ * Day partitions keep their name based index, see db_partitions.h.
+ */
+#define STREAM_ID_OF(name) "(SELECT id FROM stream_ids WHERE name = " name ")"
+
+// Trigger giving rows of a table inserted without a stream_id their ID
+#define STREAM_ID_TRIGGER_SQL(table) \
+    "CREATE TRIGGER IF NOT EXISTS " table "_stream_id AFTER INSERT ON " table " " \
+    "WHEN NEW.stream_id IS NULL AND NEW.stream_name IS NOT NULL BEGIN " \
+    "INSERT OR IGNORE INTO stream_ids (name) VALUES (NEW.stream_name); " \
+    "UPDATE " table " SET stream_id = " STREAM_ID_OF("NEW.stream_name") " WHERE id = NEW.id; " \
+    "END;"
+
 /**
  * Add a stream configuration to the database
  *
@@ -78,4 +105,18 @@ int get_enabled_stream_count(void);
  */
 int is_stream_eligible_for_live_streaming(const char *stream_name);
 
+/**
+ * Note that the streams table changed
+ * Called by the functions above; code writing the table itself calls it too,
+ * so the stream manager's configuration snapshots are read again.
+ */
+void stream_configs_changed(void);
+
+/**
+ * Get the generation of the streams table, which changes with every write
+ *
+ * @return Generation, never 0
+ */
+unsigned int stream_configs_generation(void);
+
 #endif // LIGHTNVR_DB_STREAMS_H
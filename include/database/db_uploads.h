@@ -0,0 +1,83 @@
+/**
+ * Queue of recordings waiting to be uploaded offsite
+ *
+ * One row per recording, kept until its upload finished or was given up,
+ * so clips queued before a restart are still uploaded. The file path and
+ * stream are read from the recording each time, so a recording moved to
+ * the archive meanwhile is uploaded from there. An S3 multipart upload in
+ * progress keeps its upload ID and the ETags of its finished parts, and
+ * continues after the last of them.
+ */
+
+#ifndef LIGHTNVR_DB_UPLOADS_H
+#define LIGHTNVR_DB_UPLOADS_H
+
+#include <stdint.h>
+#include <time.h>
+
+// Queued upload
+typedef struct {
+    int64_t id;
+    uint64_t recording_id;
+    int attempts;               // Failed attempts so far
+    char upload_id[256];        // S3 multipart upload in progress, empty if none
+    char *parts;                // Comma-separated ETags of its finished parts, to free
+    char file_path[256];        // Empty if the recording was deleted
+    char stream_name[64];
+} upload_entry_t;
+
+/**
+ * Queue a recording for upload; queuing it again has no effect
+ *
+ * @param recording_id Recording ID
+ * @return 0 on success, -1 on error
+ */
+int add_upload(uint64_t recording_id);
+
+/**
+ * Get the queued upload that is due first
+ *
+ * @param now Current time
+ * @param entry Receives the upload; free entry->parts
+ * @return 1 if an upload is due, 0 if none, -1 on error
+ */
+int get_next_upload(time_t now, upload_entry_t *entry);
+
+/**
+ * Get when the next queued upload is due
+ *
+ * @param when Receives the time
+ * @return 1 if uploads are queued, 0 if none, -1 on error
+ */
+int get_next_upload_time(time_t *when);
+
+/**
+ * Record the progress of a multipart upload
+ *
+ * @param id Upload ID from get_next_upload()
+ * @param upload_id S3 upload ID, NULL to start over
+ * @param parts Comma-separated ETags of the finished parts, NULL for none
+ * @return 0 on success, -1 on error
+ */
+int set_upload_progress(int64_t id, const char *upload_id, const char *parts);
+
+/**
+ * Record a failed attempt
+ *
+ * @param id Upload ID from get_next_upload()
+ * @param attempts Failed attempts including this one
+ * @param next_attempt Time to try again
+ * @param error What failed
+ * @return 0 on success, -1 on error
+ */
+int retry_upload(int64_t id, int attempts, time_t next_attempt, const char *error);
+
+/**
+ * Remove an upload from the queue once it is done or given up
+ *
+ * @param id Upload ID from get_next_upload()
+ * @return 0 on success, -1 on error
+ */
+int remove_upload(int64_t id);
+
+#endif /* LIGHTNVR_DB_UPLOADS_H */
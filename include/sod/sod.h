@@ -156,7 +156,12 @@ typedef enum {
 	SOD_RNN_CALLBACK,
 	SOD_RNN_TEXT_LENGTH,
 	SOD_RNN_DATA_LENGTH,
-	SOD_RNN_SEED
+	SOD_RNN_SEED,
+	SOD_CNN_GEMM_THREADS, /* int: threads a large matrix product is split over, process wide (SOD_BLOCKED_GEMM builds) */
+	SOD_CNN_INT8_CALIBRATE, /* int: record layer input ranges on each prediction, for sod_cnn_save_int8() */
+	SOD_CNN_INT8_MODEL, /* const char *: load an int8 model written by sod_cnn_save_int8() */
+	SOD_CNN_BATCH_CAPACITY, /* int *: receives the most images sod_cnn_predict_batch() takes in one call */
+	SOD_CNN_OPENCL /* int: run convolutional and maxpool layers on the GPU through OpenCL (SOD_OPENCL builds) */
 }SOD_CNN_CONFIG;
 /* 
  * RNN Consumer callback to be used in conjunction with the `SOD_RNN_CALLBACK` configuration verb.
@@ -219,7 +224,8 @@ typedef enum {
 	SOD_REALNET_MODEL_NMS,
 	SOD_REALNET_MODEL_DISCARD_NULL_BOXES,
 	SOD_REALNET_MODEL_NAME,
-	SOD_REALNET_MODEL_ABOUT_INFO
+	SOD_REALNET_MODEL_ABOUT_INFO,
+	SOD_REALNET_MODEL_THREADS
 }SOD_REALNET_MODEL_CONFIG;
 /*
  * SOD Embedded C/C++ API. 
@@ -234,11 +240,15 @@ typedef enum {
  * The interfaces are documented at https://sod.pixlab.io/api.html#cnn.
  */
 SOD_APIEXPORT int  sod_cnn_create(sod_cnn **ppOut, const char *zArch, const char *zModelPath, const char **pzErr);
+SOD_APIEXPORT int  sod_cnn_create_shared(sod_cnn **ppOut, const char *zArch, sod_cnn *pWeights, const char **pzErr);
 SOD_APIEXPORT int  sod_cnn_config(sod_cnn *pNet, SOD_CNN_CONFIG conf, ...);
 SOD_APIEXPORT int  sod_cnn_predict(sod_cnn *pNet, float *pInput, sod_box **paBox, int *pnBox);
 SOD_APIEXPORT void sod_cnn_destroy(sod_cnn *pNet);
 SOD_APIEXPORT float *  sod_cnn_prepare_image(sod_cnn *pNet, sod_img in);
 SOD_APIEXPORT int sod_cnn_get_network_size(sod_cnn *pNet, int *pWidth, int *pHeight, int *pChannels);
+SOD_APIEXPORT int sod_cnn_save_int8(sod_cnn *pNet, const char *zPath);
+SOD_APIEXPORT int sod_cnn_predict_batch(sod_cnn *pNet, float *pInput, int nImg, int nThreads);
+SOD_APIEXPORT int sod_cnn_batch_boxes(sod_cnn *pNet, int iImg, int nWidth, int nHeight, sod_box **paBox, int *pnBox);
 #endif /* SOD_DISABLE_CNN */
 #ifndef SOD_DISABLE_REALNET
 /*
@@ -400,6 +410,23 @@ SOD_APIEXPORT sod_img sod_img_load_from_cv_stream(CvCapture *cap);
 SOD_APIEXPORT int  sod_img_fill_from_cv_stream(CvCapture *cap, sod_img *pImg);
 SOD_APIEXPORT void sod_img_save_to_cv_jpg(sod_img im, const char *zPath);
 #endif /* SOD_ENABLE_OPENCV */
+/*
+ * Compute kernels, for benchmarks and tests.
+ *
+ * zKernel is "gemm" (the matrix product of the CNN layers) or "nms".
+ * sod_kernel_variants() lists the implementations compiled in that the CPU
+ * supports, default first; sod_kernel_use() switches every later call to
+ * one of them, or back to the default with a NULL zVariant. Switching is
+ * not thread safe and must not happen while a network runs.
+ *
+ * sod_kernel_nms() runs single class NMS over nBox boxes and zeroes the
+ * scores of the suppressed ones. It returns the number of boxes kept.
+ */
+SOD_APIEXPORT int sod_kernel_variants(const char *zKernel, const char **azVariant, int nMax);
+SOD_APIEXPORT int sod_kernel_use(const char *zKernel, const char *zVariant);
+SOD_APIEXPORT void sod_kernel_gemm(int TA, int TB, int M, int N, int K, float ALPHA, float *A, int lda, float *B, int ldb, float BETA, float *C, int ldc);
+SOD_APIEXPORT void sod_kernel_im2col(float *data_im, int channels, int height, int width, int ksize, int stride, int pad, float *data_col);
+SOD_APIEXPORT int sod_kernel_nms(const sod_box *aBox, float *aScore, int nBox, float thresh);
 /*
  * SOD Embedded Release Information & Copyright Notice.
  */
@@ -0,0 +1,65 @@
+/**
+ * @file archive_worker.h
+ * @brief Moves aged recordings from local storage to secondary storage
+ *
+ * With [storage] archive_path set, a worker thread copies finished
+ * recordings older than archive_after_hours to archive_path, at most
+ * archive_rate_kbps. Once a copy is complete and synced, the recording's
+ * file_path is switched to it in one update and the local file removed, so
+ * everything that reads recordings through the database follows the file
+ * to whichever tier holds it.
+ */
+
+#ifndef LIGHTNVR_ARCHIVE_WORKER_H
+#define LIGHTNVR_ARCHIVE_WORKER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+#include "database/db_recordings.h"
+
+/**
+ * Start the archive worker if archive_path is set
+ *
+ * @return 0 on success or when archiving is off, -1 on error
+ */
+int start_archive_worker(void);
+
+/**
+ * Stop the archive worker; a copy in progress is abandoned and its
+ * recording stays local
+ */
+void stop_archive_worker(void);
+
+/**
+ * Get archive_path with a trailing slash, which every archived file path
+ * starts with
+ *
+ * @param prefix Buffer to fill
+ * @param size Size of prefix
+ * @return 0 on success, -1 if archiving is off
+ */
+int get_archive_prefix(char *prefix, size_t size);
+
+/**
+ * Delete archived recordings older than the global retention
+ * The directory walk of the storage manager only covers local storage, so
+ * archived files are deleted through the deletion worker instead.
+ *
+ * @param max_age Maximum age in seconds
+ * @return Number of recordings deleted, or -1 on error
+ */
+int expire_archived_recordings(uint64_t max_age);
+
+/**
+ * Find the file of a recording, following it if it was archived after
+ * its metadata was read
+ *
+ * @param recording Recording metadata; file_path is updated if the file moved
+ * @param st Receives the file status
+ * @return 0 if the file exists, -1 if not
+ */
+int locate_recording_file(recording_metadata_t *recording, struct stat *st);
+
+#endif // LIGHTNVR_ARCHIVE_WORKER_H
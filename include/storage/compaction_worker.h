@@ -0,0 +1,38 @@
+/**
+ * @file compaction_worker.h
+ * @brief Compacts short clips into hourly files and thins aged recordings
+ *
+ * With [storage] compact_clip_seconds set, a worker thread looks for
+ * finished MP4 clips shorter than that which are compact_after_hours old,
+ * such as the clips of detection-based recording. Each run of clips of a
+ * stream within one hour, with the same codec and resolution, is copied
+ * without decoding into one MP4 beside them, one chapter per clip. Once the
+ * file is complete and synced, all their recordings are pointed at it in
+ * one transaction (see database/db_compaction.h) and the clips are removed.
+ *
+ * With [storage] thin_after_days set, the same worker rewrites recordings
+ * older than that with only their key frames, in place, and marks them
+ * thinned. With two second GOPs that keeps a small fraction of the bytes,
+ * as a time-lapse of the same length, until retention_days deletes them.
+ *
+ * The worker runs at idle priority and only while the load governor sheds
+ * nothing and the CPU is mostly idle. Archived clips, clips waiting for
+ * upload and recordings kept as HLS segments are left alone.
+ */
+
+#ifndef LIGHTNVR_COMPACTION_WORKER_H
+#define LIGHTNVR_COMPACTION_WORKER_H
+
+/**
+ * Start the compaction worker if compact_clip_seconds or thin_after_days is set
+ *
+ * @return 0 on success or when both are off, -1 on error
+ */
+int start_compaction_worker(void);
+
+/**
+ * Stop the compaction worker, once the file being written is finished
+ */
+void stop_compaction_worker(void);
+
+#endif // LIGHTNVR_COMPACTION_WORKER_H
@@ -0,0 +1,60 @@
+/**
+ * @file deletion_worker.h
+ * @brief Unlinks deleted recording files in the background
+ *
+ * Unlinking a large MP4 can block for seconds on ext4 or a network mount.
+ * Deleting a recording therefore only removes its metadata and queues the
+ * file in the database; a worker thread with idle I/O priority unlinks the
+ * queued files, several at a time. The queue survives restarts and is
+ * drained at startup.
+ */
+
+#ifndef LIGHTNVR_DELETION_WORKER_H
+#define LIGHTNVR_DELETION_WORKER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "database/db_recordings.h"
+
+/**
+ * Start the deletion worker, which first drains what is left in the queue
+ *
+ * @return 0 on success, -1 on error
+ */
+int start_deletion_worker(void);
+
+/**
+ * Stop the deletion worker; queued files are deleted after the next start
+ */
+void stop_deletion_worker(void);
+
+/**
+ * Delete a recording, leaving its file to the deletion worker
+ *
+ * @param id Recording ID
+ * @return 0 on success, -1 if the recording could not be deleted
+ */
+int delete_recording_async(uint64_t id);
+
+/**
+ * Delete many recordings in one transaction, leaving their files to the
+ * deletion worker
+ *
+ * @param ids Recording IDs
+ * @param count Number of IDs
+ * @param deleted Receives whether each ID was deleted; may be NULL
+ * @param progress Called as chunks of IDs are processed; may be NULL
+ * @param opaque Passed to progress
+ * @return Number of recordings deleted, or -1 if none could be deleted
+ */
+int delete_recordings_async(const uint64_t *ids, int count, bool *deleted,
+                            recording_delete_progress_fn progress, void *opaque);
+
+/**
+ * Give the calling thread idle I/O and low CPU priority, so background
+ * file work never competes with recording writes
+ */
+void lower_thread_priority(void);
+
+#endif // LIGHTNVR_DELETION_WORKER_H
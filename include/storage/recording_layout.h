@@ -0,0 +1,87 @@
+/**
+ * Recording directory layout
+ *
+ * Recordings of a stream live in its directory on a recording volume, the
+ * MP4 storage path unless further volumes are configured (see
+ * storage/storage_volumes.h).
+ * With [storage] shard_recordings, new ones go in one directory per hour,
+ * <stream>/YYYY/MM/DD/HH/, so no directory grows without bound; older
+ * recordings may still sit directly in the stream directory. The database
+ * holds the full path of every recording, so nothing has to guess which
+ * layout a recording uses.
+ */
+
+#ifndef LIGHTNVR_RECORDING_LAYOUT_H
+#define LIGHTNVR_RECORDING_LAYOUT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+
+// Levels of shard directories below a stream directory
+#define RECORDING_SHARD_DEPTH 4
+
+/**
+ * Get the directory a stream's next recording goes in, on the volume chosen for it
+ *
+ * @param stream_name Name of the stream
+ * @param dir Buffer receiving the path
+ * @param size Size of the buffer
+ * @return 0 on success, -1 if the path does not fit
+ */
+int recording_layout_stream_dir(const char *stream_name, char *dir, size_t size);
+
+/**
+ * Get the shard directory of an hour, <stream_dir>/YYYY/MM/DD/HH in local time
+ *
+ * @param stream_dir Directory of the stream's recordings
+ * @param time Time within the hour
+ * @param dir Buffer receiving the path
+ * @param size Size of the buffer
+ * @return 0 on success, -1 if the path does not fit
+ */
+int recording_layout_shard_dir(const char *stream_dir, time_t time, char *dir, size_t size);
+
+/**
+ * Get the directory a new recording goes in and create it
+ * This is the shard directory of the hour with shard_recordings, otherwise
+ * the stream directory.
+ *
+ * @param stream_name Name of the stream
+ * @param time Start time of the recording
+ * @param dir Buffer receiving the path
+ * @param size Size of the buffer
+ * @return 0 on success, -1 on error
+ */
+int recording_layout_dir(const char *stream_name, time_t time, char *dir, size_t size);
+
+/**
+ * Create a directory and its missing parents
+ *
+ * @return 0 on success, -1 on error
+ */
+int recording_layout_make_dirs(const char *dir);
+
+/**
+ * Check whether a directory name is one of a shard level (year, month, day or hour)
+ */
+bool recording_layout_is_shard_name(const char *name);
+
+/**
+ * Check whether a recording is already in a shard directory
+ *
+ * @param path Path of the recording file or directory
+ */
+bool recording_layout_is_sharded(const char *path);
+
+/**
+ * Remove the shard directories above a deleted recording that are left empty
+ * Stops at the first directory that still has entries, at the stream
+ * directory, and at the directory of the current hour, which a writer may be
+ * about to use.
+ *
+ * @param path Path the deleted recording had
+ */
+void recording_layout_prune(const char *path);
+
+#endif /* LIGHTNVR_RECORDING_LAYOUT_H */
@@ -0,0 +1,53 @@
+/**
+ * @file retention_engine.h
+ * @brief Deletes the oldest recordings across all streams when the disk fills
+ *
+ * A background worker watches free space on the storage path. Once it
+ * falls below [storage] min_free_percent, recordings are deleted in global
+ * oldest-first order until target_free_percent is free again. The next
+ * recording to go is taken from a min-heap holding the oldest finished
+ * recording of each stream, with retention_priority_hours making the
+ * recordings of higher priority streams count as younger. Best-effort
+ * streams are emptied before any other, critical streams only once nothing
+ * else is left.
+ *
+ * With several recording volumes, the file system of each is watched on
+ * its own, and a volume low on space only loses recordings stored on it.
+ *
+ * Independently of free space, the worker keeps each stream within its own
+ * retention_days and max_storage_bytes, checked against the recording
+ * usage totals so that no directory is walked.
+ */
+
+#ifndef LIGHTNVR_RETENTION_ENGINE_H
+#define LIGHTNVR_RETENTION_ENGINE_H
+
+#include <stdint.h>
+
+/**
+ * Start the retention worker
+ *
+ * @param storage_path Path whose file system is watched for the first volume
+ * @return 0 on success, -1 on error
+ */
+int start_retention_engine(const char *storage_path);
+
+/**
+ * Stop the retention worker, waiting for a running batch to finish
+ */
+void stop_retention_engine(void);
+
+/**
+ * Wake the retention worker to check free space now
+ */
+void request_retention_pass(void);
+
+/**
+ * Get what the retention worker has deleted since it started
+ *
+ * @param recordings Receives the number of recordings deleted (may be NULL)
+ * @param bytes Receives the bytes freed (may be NULL)
+ */
+void get_retention_engine_stats(uint64_t *recordings, uint64_t *bytes);
+
+#endif // LIGHTNVR_RETENTION_ENGINE_H
@@ -0,0 +1,116 @@
+/**
+ * Storage Write-Behind I/O
+ *
+ * One I/O thread per disk (st_dev of the directory a file is created in)
+ * with a bounded queue of large chunks. Writers copy muxer output into the
+ * current chunk of their file and return immediately; the I/O thread does
+ * the pwrite, a periodic fdatasync and posix_fadvise(DONTNEED), so neither
+ * a slow flush nor SD card garbage collection stalls the recording threads,
+ * and recordings do not evict the page cache of the rest of the system.
+ *
+ * Memory use is bounded by STORAGE_IO_QUEUE_LIMIT per disk plus one chunk
+ * per open file. A writer only blocks when its disk is so far behind that
+ * the whole queue is full.
+ *
+ * Built with liburing (-DENABLE_IO_URING=ON), each I/O thread submits what
+ * is queued as one batch of writes from registered buffers, followed by the
+ * data syncs that are due, instead of a system call per chunk; preallocation
+ * also runs on the I/O thread. Where io_uring is not available at run time
+ * the threads fall back to system calls.
+ */
+
+#ifndef LIGHTNVR_STORAGE_IO_H
+#define LIGHTNVR_STORAGE_IO_H
+
+#include <stdint.h>
+#include <libavformat/avio.h>
+
+// Size of a write submitted to the I/O thread, a multiple of the page size
+#define STORAGE_IO_CHUNK_SIZE (256 * 1024)
+
+// Most bytes queued per disk before writers have to wait
+#define STORAGE_IO_QUEUE_LIMIT (8 * 1024 * 1024)
+
+typedef struct storage_io_file storage_io_file_t;
+
+/**
+ * Create a file written through the I/O thread of its disk
+ *
+ * @param path Path of the file, created or truncated
+ * @param expected_size Size to preallocate, or 0 if unknown
+ * @return File, or NULL on error
+ */
+storage_io_file_t *storage_io_open(const char *path, int64_t expected_size);
+
+/**
+ * Queue data at the current position
+ *
+ * @param file File
+ * @param data Data, copied before returning
+ * @param size Size of the data
+ * @return size on success, negative AVERROR if a previous write failed
+ */
+int storage_io_write(storage_io_file_t *file, const uint8_t *data, int size);
+
+/**
+ * Move the position for the following writes
+ *
+ * @param file File
+ * @param offset Offset
+ * @param whence SEEK_SET, SEEK_CUR, SEEK_END or AVSEEK_SIZE
+ * @return New position, the size for AVSEEK_SIZE, or negative AVERROR
+ */
+int64_t storage_io_seek(storage_io_file_t *file, int64_t offset, int whence);
+
+/**
+ * Wait for the queued data of a file and close it
+ *
+ * @param file File, freed
+ * @return Size of the file, or negative AVERROR if a write failed
+ */
+int64_t storage_io_close(storage_io_file_t *file);
+
+/**
+ * Create a file written through the I/O thread as an AVIOContext
+ *
+ * @param pb Receives the context
+ * @param path Path of the file
+ * @param expected_size Size to preallocate, or 0 if unknown
+ * @return 0 on success, negative AVERROR on error
+ */
+int storage_io_open_avio(AVIOContext **pb, const char *path, int64_t expected_size);
+
+/**
+ * Check whether an AVIOContext was created by storage_io_open_avio
+ *
+ * @param pb Context
+ * @return 1 if it was, 0 otherwise
+ */
+int storage_io_is_avio(const AVIOContext *pb);
+
+/**
+ * Rename the file behind a context created by storage_io_open_avio
+ * Writes already queued land in the renamed file; both paths must be on
+ * the same file system.
+ *
+ * @param pb Context
+ * @param path New path of the file
+ * @return 0 on success, negative AVERROR on error
+ */
+int storage_io_rename_avio(AVIOContext *pb, const char *path);
+
+/**
+ * Flush, close and free a context created by storage_io_open_avio
+ *
+ * @param pb Context, set to NULL
+ * @return Size of the file, or negative AVERROR if a write failed
+ */
+int64_t storage_io_close_avio(AVIOContext **pb);
+
+/**
+ * Stop the I/O threads once their queues are written
+ * Called at shutdown after all writers are closed.
+ */
+void storage_io_shutdown(void);
+
+#endif /* LIGHTNVR_STORAGE_IO_H */
@@ -0,0 +1,117 @@
+/**
+ * Storage Latency Monitor
+ *
+ * The storage I/O thread of each disk (see storage_io.h) times its writes
+ * and data syncs. Every couple of seconds the monitor takes the p50 and p99
+ * of the last half minute, publishes them as metrics and rates each disk:
+ *
+ *   ok:       p99 below [storage] latency_slow_ms
+ *   slow:     p99 at or above latency_slow_ms; the disk writes in larger
+ *             batches and syncs less often, and thumbnails, compaction and
+ *             archiving wait
+ *   critical: p99 at or above latency_critical_ms, a write stuck that long,
+ *             or recorders waiting for a full queue; live HLS segments are
+ *             also kept in memory instead of on the disk
+ *
+ * Recording itself is never deferred. A disk is rated worse as soon as a
+ * sample shows it and better one step at a time once it has been quiet for
+ * a while. Getting worse is logged and stored as a storage event, so the
+ * operator hears of a failing card before recorders start dropping frames.
+ */
+
+#ifndef LIGHTNVR_STORAGE_LATENCY_H
+#define LIGHTNVR_STORAGE_LATENCY_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+// Disks tracked; the storage I/O threads use as many at most
+#define STORAGE_LATENCY_MAX_DEVICES 8
+
+typedef enum {
+    STORAGE_LATENCY_OK = 0,
+    STORAGE_LATENCY_SLOW,
+    STORAGE_LATENCY_CRITICAL
+} storage_latency_level_t;
+
+typedef enum {
+    STORAGE_OP_WRITE = 0,
+    STORAGE_OP_SYNC,
+    STORAGE_OP_COUNT
+} storage_op_t;
+
+/**
+ * Start rating the disks, if latency_slow_ms is set
+ *
+ * @return 0 on success (or when disabled), -1 on error
+ */
+int storage_latency_init(void);
+
+/**
+ * Stop rating the disks; all are rated ok from then on
+ */
+void storage_latency_shutdown(void);
+
+/**
+ * Get the slot of a disk, adding it on first use
+ *
+ * @param device st_dev of the disk
+ * @return Slot, or -1 if all are taken
+ */
+int storage_latency_register(dev_t device);
+
+/**
+ * Note that an operation on a disk starts
+ * A write that does not come back is noticed before it completes.
+ *
+ * @param slot Slot of the disk, -1 is ignored
+ * @return Start time for storage_latency_end()
+ */
+uint64_t storage_latency_begin(int slot);
+
+/**
+ * Record the time an operation took
+ *
+ * @param slot Slot of the disk, -1 is ignored
+ * @param op Kind of operation
+ * @param start_us Value returned by storage_latency_begin()
+ */
+void storage_latency_end(int slot, storage_op_t op, uint64_t start_us);
+
+/**
+ * Note that a recorder had to wait for the queue of a disk
+ *
+ * @param slot Slot of the disk, -1 is ignored
+ */
+void storage_latency_writer_waited(int slot);
+
+/**
+ * Get the rating of a disk
+ *
+ * @param slot Slot of the disk
+ * @return Rating, STORAGE_LATENCY_OK for -1 or while the monitor is stopped
+ */
+storage_latency_level_t storage_latency_level(int slot);
+
+/**
+ * Get the rating of the disk holding a path
+ *
+ * @param path File or directory
+ * @return Rating, STORAGE_LATENCY_OK for disks not written through the I/O threads
+ */
+storage_latency_level_t storage_latency_level_of_path(const char *path);
+
+/**
+ * Get the worst rating of all disks
+ */
+storage_latency_level_t storage_latency_worst_level(void);
+
+/**
+ * Name of a rating, for logs and metrics
+ *
+ * @param level Rating
+ * @return Static string
+ */
+const char *storage_latency_level_name(storage_latency_level_t level);
+
+#endif /* LIGHTNVR_STORAGE_LATENCY_H */
@@ -138,7 +138,8 @@ int set_retention_days(int days);
 bool is_storage_available(void);
 
 /**
- * Get path to a recording file
+ * Get path to a new recording file
+ * The directory it goes in is created (see recording_layout.h).
  *
  * @param stream_name Name of the stream
  * @param timestamp Timestamp for the recording
@@ -0,0 +1,71 @@
+/**
+ * Recording Volumes
+ *
+ * Recordings can be spread over several disks: volume 0 is the MP4 storage
+ * path, and [storage] volumes lists further ones, each a directory holding
+ * one directory per stream like the MP4 storage path. Every new recording
+ * goes on a volume chosen by [storage] volume_placement:
+ *
+ *  - round_robin: each stream stays on the volume it was first given, the
+ *    streams taking the volumes in turn
+ *  - free_space: each recording goes on the volume with the most free space
+ *  - pinned: streams stay on the volume [storage] volume_pins gives them;
+ *    others are spread by a hash of their name
+ *
+ * A volume that cannot be written, such as a failed disk or a missing
+ * mount, is passed over for a while and its streams record on the others.
+ * Each volume is written by the storage I/O thread of its disk, and the
+ * retention engine keeps free space on each volume separately. Recordings
+ * are found through the full path the database holds, so playback does not
+ * need to know which volume a recording is on.
+ */
+
+#ifndef LIGHTNVR_STORAGE_VOLUMES_H
+#define LIGHTNVR_STORAGE_VOLUMES_H
+
+#include <stddef.h>
+
+// Most volumes, the MP4 storage path included
+#define STORAGE_MAX_VOLUMES 8
+
+/**
+ * Get the number of recording volumes, at least 1
+ */
+int storage_volumes_count(void);
+
+/**
+ * Get the directory of a volume
+ *
+ * @param volume Index of the volume, 0 being the MP4 storage path
+ * @param path Buffer receiving the path
+ * @param size Size of the buffer
+ * @return 0 on success, -1 if there is no such volume or the path does not fit
+ */
+int storage_volume_path(int volume, char *path, size_t size);
+
+/**
+ * Get the volume a recording is on
+ *
+ * @param path Path of the recording
+ * @return Index of the volume; 0 for paths on none of the further volumes
+ */
+int storage_volume_of_path(const char *path);
+
+/**
+ * Choose the volume of a stream's next recording and get its directory
+ *
+ * @param stream_name Name of the stream
+ * @param dir Buffer receiving <volume>/<stream>
+ * @param size Size of the buffer
+ * @return Index of the volume, or -1 if the path does not fit
+ */
+int storage_volume_stream_dir(const char *stream_name, char *dir, size_t size);
+
+/**
+ * Pass over the volume holding a path for a while after writing to it failed
+ *
+ * @param path Path on the volume
+ */
+void storage_volume_failed(const char *path);
+
+#endif /* LIGHTNVR_STORAGE_VOLUMES_H */
@@ -0,0 +1,55 @@
+/**
+ * @file upload_worker.h
+ * @brief Uploads event clips offsite in the background
+ *
+ * With [upload] url set, the finished recordings of detection-based streams,
+ * announced by the MP4 writers on the event bus, are queued in the database
+ * and a worker thread uploads them one at a time, read straight from their
+ * MP4 files. One upload runs at a time, so rate_kbps caps all uploading
+ * together. The worker runs at idle priority
+ * and waits while the load governor sheds work, and a failed upload is
+ * tried again later with a growing delay, so uploads never compete with
+ * recording for the uplink or the disk.
+ *
+ * Each clip is PUT to url/<stream>/<file name>. With s3_region set, requests
+ * are signed with AWS Signature Version 4 and clips larger than one part
+ * are sent as S3 multipart uploads, which continue after the last finished
+ * part when interrupted, also across restarts.
+ */
+
+#ifndef LIGHTNVR_UPLOAD_WORKER_H
+#define LIGHTNVR_UPLOAD_WORKER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Start the upload worker if [upload] url is set
+ * Clips queued before the last shutdown are uploaded first.
+ *
+ * @return 0 on success or when uploading is off, -1 on error
+ */
+int start_upload_worker(void);
+
+/**
+ * Stop the upload worker; an upload in progress is abandoned and tried
+ * again on the next start
+ */
+void stop_upload_worker(void);
+
+/**
+ * Whether finished clips are to be queued for upload
+ *
+ * @return true if [upload] url is set
+ */
+bool upload_worker_enabled(void);
+
+/**
+ * Queue a finished recording for upload and wake the worker
+ *
+ * @param recording_id Recording ID
+ * @return 0 on success, -1 on error
+ */
+int upload_worker_queue(uint64_t recording_id);
+
+#endif // LIGHTNVR_UPLOAD_WORKER_H
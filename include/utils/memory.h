@@ -60,8 +60,55 @@ int safe_strcat(char *dest, const char *src, size_t size);
  */
 void secure_zero_memory(void *ptr, size_t size);
 
+/*
+ * Memory accounting
+ *
+ * Subsystems report what they allocate under a tag. Each thread adds to its
+ * own counters and only folds them into the shared totals once they have
+ * moved by MEMORY_FLUSH_BYTES, so tracking costs no atomic operation on most
+ * calls; totals and peaks are accurate to that amount per thread. Memory
+ * freed by another thread than the one that allocated it is accounted
+ * correctly, a thread's counters are folded in when it exits.
+ *
+ * Packet payloads are counted once, by the pool that allocates them, and not
+ * again by the buffers holding references to them.
+ *
+ * With a budget set, subsystems check memory_budget_allows() before taking
+ * on optional work (detection runs, model loads, cached web files) and skip
+ * it while the tracked total is over the budget.
+ */
+
+// Movement of a thread's counter that is folded into the shared totals
+#define MEMORY_FLUSH_BYTES (64 * 1024)
+
+// Budget in MB applied when none is configured, set by the embedded A1 build
+// (-1 = taken from the device profile)
+#ifndef MEMORY_BUDGET_DEFAULT_MB
+#define MEMORY_BUDGET_DEFAULT_MB -1
+#endif
+
+typedef enum {
+    MEMORY_TAG_OTHER = 0,
+    MEMORY_TAG_INGEST,          // Packet payloads of the shared ingest
+    MEMORY_TAG_HLS,             // LL-HLS parts and segments held in memory
+    MEMORY_TAG_MP4,             // MP4 recording and writer contexts
+    MEMORY_TAG_DETECTION,       // Motion detection arenas and detection frame buffers
+    MEMORY_TAG_MODELS,          // Loaded detection models
+    MEMORY_TAG_DB,              // SQLite page cache and heap
+    MEMORY_TAG_WEB,             // Cached web interface files
+    MEMORY_TAG_LOGGER,          // Log ring and queue
+    MEMORY_TAG_COUNT
+} memory_tag_t;
+
+// Usage of one tag
+typedef struct {
+    size_t current;             // Bytes in use
+    size_t peak;                // Most bytes in use since startup
+} memory_usage_t;
+
 /**
  * Track memory allocations for debugging and leak detection
+ * Counted under MEMORY_TAG_OTHER.
  *
  * @param size Size of memory being allocated or freed
  * @param is_allocation True if allocating, false if freeing
@@ -71,15 +118,71 @@ void track_memory_allocation(size_t size, bool is_allocation);
 /**
  * Get the total amount of memory currently allocated
  *
- * @return Total memory allocated in bytes
+ * @return Total memory allocated in bytes, over all tags
  */
 size_t get_total_memory_allocated(void);
 
 /**
  * Get the peak memory usage since program start
  *
- * @return Peak memory allocated in bytes
+ * @return Peak memory allocated in bytes, over all tags
  */
 size_t get_peak_memory_allocated(void);
 
+/**
+ * Account memory allocated or freed by a subsystem
+ *
+ * @param tag Subsystem
+ * @param size Size of memory being allocated or freed
+ * @param is_allocation True if allocating, false if freeing
+ */
+void memory_track(memory_tag_t tag, size_t size, bool is_allocation);
+
+/**
+ * Have a subsystem that measures its own memory report it for a tag
+ * The function is called whenever usage is read, instead of counting.
+ *
+ * @param tag Subsystem
+ * @param usage Returns the bytes in use, must be cheap and thread-safe (NULL to count again)
+ */
+void memory_set_usage_source(memory_tag_t tag, size_t (*usage)(void));
+
+/**
+ * Get the usage of every tag
+ *
+ * @param usage Receives MEMORY_TAG_COUNT entries, indexed by tag
+ */
+void memory_get_usage(memory_usage_t usage[MEMORY_TAG_COUNT]);
+
+/**
+ * Set up accounting: apply the budget and publish the usage as metrics
+ *
+ * @param budget_bytes Total budget, 0 for none
+ */
+void memory_accounting_init(size_t budget_bytes);
+
+/**
+ * Get the memory budget
+ *
+ * @return Budget in bytes, 0 if none is set
+ */
+size_t memory_get_budget(void);
+
+/**
+ * Check whether a subsystem may take on optional work
+ *
+ * @param tag Subsystem asking
+ * @param size Bytes the work would allocate (0 if unknown)
+ * @return false if it would put the tracked total over the budget
+ */
+bool memory_budget_allows(memory_tag_t tag, size_t size);
+
+/**
+ * Name of a tag, for logs, the API and metrics
+ *
+ * @param tag Tag
+ * @return Static string
+ */
+const char *memory_tag_name(memory_tag_t tag);
+
 #endif /* MEMORY_UTILS_H */
@@ -0,0 +1,64 @@
+/**
+ * Annex B Bitstream Filter
+ *
+ * Long-lived h264_mp4toannexb / hevc_mp4toannexb context per output. Whether
+ * packets need converting is decided once from the codec parameters: RTSP
+ * sources already deliver Annex B and pass through untouched, and only
+ * sources with avcC/hvcC extradata (length-prefixed NAL units) get a filter.
+ * The filter is rebuilt only when the codec parameters of the input change,
+ * so the write path does no per-packet allocation or start code inspection.
+ */
+
+#ifndef LIGHTNVR_ANNEXB_FILTER_H
+#define LIGHTNVR_ANNEXB_FILTER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <libavcodec/avcodec.h>
+#include <libavcodec/bsf.h>
+
+typedef struct {
+    AVBSFContext *ctx;          // NULL when packets pass through unchanged
+    bool configured;
+    enum AVCodecID codec_id;    // Parameters the filter was set up for
+    const uint8_t *extradata;
+    int extradata_size;
+} annexb_filter_t;
+
+/**
+ * Set up the filter for the codec parameters of an input stream
+ * Returns immediately if the parameters are the ones already configured.
+ *
+ * @param filter Filter, zero-initialized before first use
+ * @param codecpar Codec parameters of the input stream
+ * @param time_base Time base of the packets
+ * @return 0 on success, negative AVERROR on error (packets then pass through)
+ */
+int annexb_filter_configure(annexb_filter_t *filter, const AVCodecParameters *codecpar, AVRational time_base);
+
+/**
+ * Get the codec parameters of the filtered packets
+ *
+ * @param filter Filter
+ * @return Output parameters, or NULL if packets pass through unchanged
+ */
+const AVCodecParameters *annexb_filter_output_parameters(const annexb_filter_t *filter);
+
+/**
+ * Convert a packet to Annex B in place
+ *
+ * @param filter Filter
+ * @param pkt Packet, replaced by the filtered packet
+ * @return 0 on success, negative AVERROR on error (the packet is then empty)
+ */
+int annexb_filter_apply(annexb_filter_t *filter, AVPacket *pkt);
+
+/**
+ * Free the filter context
+ * The filter can be configured again afterwards.
+ *
+ * @param filter Filter
+ */
+void annexb_filter_free(annexb_filter_t *filter);
+
+#endif /* LIGHTNVR_ANNEXB_FILTER_H */
@@ -18,8 +18,43 @@ int init_api_detection_system(void);
  */
 void shutdown_api_detection_system(void);
 
+/**
+ * Completion callback of an asynchronous API detection
+ * Runs on the API client thread and must return quickly; the result is only
+ * valid during the call.
+ *
+ * @param status 0 on success, -1 on failure
+ * @param result Detections found, empty on failure
+ * @param user_data Pointer passed at submission
+ */
+typedef void (*api_detection_callback_t)(int status, const detection_result_t *result, void *user_data);
+
+/**
+ * Submit a frame to the detection API without waiting for the answer
+ * The frame is JPEG encoded in memory before the call returns, so the caller
+ * may reuse it right away. Requests of all streams share a pool of
+ * keep-alive connections; each stream may have api_detection max_inflight
+ * requests out, further frames are dropped. Detections are stored in the
+ * database for named streams before the callback runs.
+ *
+ * @param api_url The URL of the detection API, or "api-detection" for the configured one
+ * @param frame_data The frame data to detect objects in
+ * @param width The width of the frame
+ * @param height The height of the frame
+ * @param channels The number of channels in the frame (1, 3 or 4)
+ * @param stream_name The name of the stream, or NULL
+ * @param callback Called once with the outcome, unless the request was not queued
+ * @param user_data Passed to the callback
+ * @return 0 if queued, 1 if dropped because the stream has too many requests out, -1 on failure
+ */
+int detect_objects_api_async(const char *api_url, const unsigned char *frame_data,
+                             int width, int height, int channels, const char *stream_name,
+                             api_detection_callback_t callback, void *user_data);
+
 /**
  * Detect objects using the API
+ * Submits the frame like detect_objects_api_async and waits for the answer;
+ * other streams' requests proceed meanwhile.
  * 
  * @param api_url The URL of the detection API
  * @param frame_data The frame data to detect objects in
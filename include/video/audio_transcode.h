@@ -0,0 +1,79 @@
+/**
+ * Audio transcoding to AAC
+ *
+ * Cameras often send G.711 (PCM μ-law or A-law), which MP4 and HLS cannot
+ * carry. A transcoder decodes it, converts the samples to the AAC encoder's
+ * planar float format and regroups them into full AAC frames; it keeps its
+ * codecs and sample FIFO for the life of a connection, so packets of any size
+ * can be fed one at a time.
+ *
+ * The shared ingest runs one transcoder per stream and hands the AAC packets
+ * to every consumer that takes audio; the MP4 writer keeps its own only when
+ * it reads the camera directly.
+ */
+
+#ifndef LIGHTNVR_AUDIO_TRANSCODE_H
+#define LIGHTNVR_AUDIO_TRANSCODE_H
+
+#include <stdbool.h>
+#include <libavcodec/avcodec.h>
+
+typedef struct audio_transcoder audio_transcoder_t;
+
+/**
+ * Check whether audio of a codec has to be transcoded to AAC
+ *
+ * @param codec_id Codec of the camera's audio
+ * @return true for G.711 (PCM μ-law and A-law)
+ */
+bool audio_transcode_needed(enum AVCodecID codec_id);
+
+/**
+ * Open a transcoder for an audio stream
+ *
+ * @param stream_name Name of the stream, for logging
+ * @param codecpar Codec parameters of the input audio
+ * @param time_base Time base of the input packets
+ * @return Transcoder or NULL on failure
+ */
+audio_transcoder_t *audio_transcoder_create(const char *stream_name, const AVCodecParameters *codecpar,
+                                            AVRational time_base);
+
+/**
+ * Get the codec parameters of the AAC output, including its extradata
+ */
+const AVCodecParameters *audio_transcoder_get_parameters(const audio_transcoder_t *tc);
+
+/**
+ * Get the time base of the output packets, 1 / sample rate
+ */
+AVRational audio_transcoder_get_time_base(const audio_transcoder_t *tc);
+
+/**
+ * Feed a packet of input audio
+ * A gap or jump of the timestamps drops the samples still waiting for a full
+ * AAC frame and restarts the output timeline at the packet.
+ *
+ * @param tc Transcoder
+ * @param pkt Input packet
+ * @return 0 on success, negative AVERROR on error
+ */
+int audio_transcoder_send_packet(audio_transcoder_t *tc, const AVPacket *pkt);
+
+/**
+ * Get the next AAC packet
+ * Call until it returns AVERROR(EAGAIN) after every audio_transcoder_send_packet.
+ *
+ * @param tc Transcoder
+ * @param pkt Receives the packet, timestamps in audio_transcoder_get_time_base
+ * @return 0 on success, AVERROR(EAGAIN) when more input is needed, other
+ *         negative AVERROR on error
+ */
+int audio_transcoder_receive_packet(audio_transcoder_t *tc, AVPacket *pkt);
+
+/**
+ * Free a transcoder and set the pointer to NULL
+ */
+void audio_transcoder_free(audio_transcoder_t **tc);
+
+#endif /* LIGHTNVR_AUDIO_TRANSCODE_H */
@@ -0,0 +1,107 @@
+/**
+ * Clip Export
+ *
+ * Exports a time range of a stream, which may span several recordings, as
+ * one fragmented MP4 written straight to a callback as it is muxed. The
+ * packets are copied without decoding. The clip starts at the key frame
+ * at or before the requested start and stops at the requested end, and
+ * the recordings follow each other without gaps on its timeline.
+ *
+ * Several clips, one per stream, can be exported as a ZIP archive in the
+ * same way. Entries are stored uncompressed, with their sizes and CRCs in
+ * data descriptors after the data, so nothing needs to be seeked or
+ * buffered. The archive uses ZIP64 records, so entries and archives may
+ * exceed 4 GB.
+ */
+
+#ifndef LIGHTNVR_CLIP_EXPORT_H
+#define LIGHTNVR_CLIP_EXPORT_H
+
+#include <stdint.h>
+#include <time.h>
+
+/**
+ * Receives the exported data in order
+ *
+ * @param opaque Value passed to the export function
+ * @param data Next bytes of the export
+ * @param size Number of bytes
+ * @return 0 to continue, negative to abort the export
+ */
+typedef int (*clip_export_write_fn)(void *opaque, const uint8_t *data, int size);
+
+// Recording a clip is taken from
+typedef struct {
+    const char *file_path;  // Located file of the recording
+    time_t start_time;      // Wall clock time the recording starts at
+    int64_t offset_ms;      // Where it starts in a file shared with others, 0 for its own file
+    int64_t duration_ms;    // Its length in a shared file, 0 for the rest of the file
+} clip_export_source_t;
+
+// Clip of one stream in a ZIP archive
+typedef struct {
+    const char *name;                       // File name in the archive
+    const clip_export_source_t *sources;    // Recordings in time order
+    int count;
+} clip_export_entry_t;
+
+/**
+ * Export a time range of recordings as one fragmented MP4
+ * The first recording sets the streams of the clip; later recordings with
+ * different video parameters are left out, and their audio is left out if
+ * it differs.
+ *
+ * @param sources Recordings of one stream in time order
+ * @param count Number of recordings
+ * @param start Wall clock time the clip starts at
+ * @param end Wall clock time the clip ends at
+ * @param write Receives the MP4 data
+ * @param opaque Passed to write
+ * @return 0 on success, -1 on failure or if write aborted the export
+ */
+int clip_export_mp4(const clip_export_source_t *sources, int count, time_t start, time_t end,
+                    clip_export_write_fn write, void *opaque);
+
+/**
+ * Copy whole recordings into one MP4 file, one after the other
+ * The recordings follow each other without gaps, each one a chapter named
+ * after its start time, and the index is written in front of the media.
+ * Recordings left out as by clip_export_mp4() get an offset of -1.
+ *
+ * @param sources Recordings of one stream in time order, with their own files
+ * @param count Number of recordings
+ * @param path File to write; removed by the caller on failure
+ * @param offsets_ms Receives where each recording starts in the file
+ * @param durations_ms Receives how long each recording lasts in the file
+ * @return 0 on success, -1 on failure
+ */
+int clip_export_compact(const clip_export_source_t *sources, int count, const char *path,
+                        int64_t *offsets_ms, int64_t *durations_ms);
+
+/**
+ * Copy only the key frames of a whole recording into an MP4 file
+ * The key frames keep their times, so the file plays as a time-lapse of
+ * the same length, and times into the recording still match. Audio is
+ * left out.
+ *
+ * @param source Recording, with its own file or a whole shared file
+ * @param path File to write; removed by the caller on failure
+ * @return 0 on success, -1 on failure
+ */
+int clip_export_keyframes(const clip_export_source_t *source, const char *path);
+
+/**
+ * Export a time range of several streams as a ZIP archive of MP4 clips
+ *
+ * @param entries Clips to export, one archive entry each
+ * @param count Number of entries
+ * @param start Wall clock time the clips start at
+ * @param end Wall clock time the clips end at
+ * @param write Receives the archive data
+ * @param opaque Passed to write
+ * @return 0 on success, -1 on failure or if write aborted the export
+ */
+int clip_export_zip(const clip_export_entry_t *entries, int count, time_t start, time_t end,
+                    clip_export_write_fn write, void *opaque);
+
+#endif /* LIGHTNVR_CLIP_EXPORT_H */
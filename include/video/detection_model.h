@@ -14,6 +14,7 @@ typedef void* detection_model_t;
 #define MODEL_TYPE_TFLITE "tflite"
 #define MODEL_TYPE_API "api"
 #define MODEL_TYPE_ONVIF "onvif"
+#define MODEL_TYPE_REMOTE "remote"
 
 /**
  * Check if a model file is supported
@@ -63,6 +64,14 @@ const char* get_model_path(detection_model_t model);
  */
 void* get_realnet_model_handle(detection_model_t model);
 
+/**
+ * Change the detection threshold of a loaded model
+ *
+ * @param model Detection model handle
+ * @param threshold New detection threshold
+ */
+void set_detection_model_threshold(detection_model_t model, float threshold);
+
 /**
  * Get the type of a loaded model
  *
@@ -71,11 +80,20 @@ void* get_realnet_model_handle(detection_model_t model);
  */
 const char* get_model_type_from_handle(detection_model_t model);
 
+/**
+ * Get the memory a loaded model is counted with, the size of its file
+ *
+ * @param model Detection model handle
+ * @return Size in bytes, 0 for models without a local file
+ */
+size_t get_model_memory_size(detection_model_t model);
+
 /**
  * Clean up old models in the global cache
  *
  * This function is kept for API compatibility but does nothing in the thread-local model approach
- * Each thread is responsible for managing its own model
+ * Each thread is responsible for managing its own model; idle models are
+ * unloaded by evict_idle_detection_models
  *
  * @param max_age Maximum age in seconds (ignored in thread-local approach)
  */
@@ -2,11 +2,14 @@
 #define DETECTION_RECORDING_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <time.h>
 #include "video/detection_result.h"
 
 /**
  * Initialize detection-based recording system
+ * Subscribes to detection and ONVIF motion events: their detections are
+ * stored and start or stop the recording of detection-based streams.
  */
 void init_detection_recording_system(void);
 
@@ -36,23 +39,6 @@ int start_detection_recording(const char *stream_name, const char *model_path, f
  */
 int stop_detection_recording(const char *stream_name);
 
-/**
- * Process detection results for recording
- * This function manages recording decisions based on detection results
- *
- * @param stream_name The name of the stream
- * @param frame_data The frame data (for debugging only)
- * @param width Frame width
- * @param height Frame height
- * @param channels Number of color channels
- * @param frame_time Timestamp of the frame
- * @param result Detection results from detect_objects call
- * @return 0 on success, -1 on error
- */
-int process_frame_for_recording(const char *stream_name, const unsigned char *frame_data,
-                               int width, int height, int channels, time_t frame_time,
-                               detection_result_t *result);
-
 /**
  * Get detection recording state for a stream
  * Returns 1 if detection recording is active, 0 if not, -1 on error
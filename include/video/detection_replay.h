@@ -0,0 +1,102 @@
+/**
+ * Detection Replay
+ *
+ * Runs object detection over recordings that are already on disk, e.g. to
+ * back-fill detections after adding a model, or to measure how fast a
+ * detection change runs on a fixed set of footage. The recordings of a
+ * stream in a time range are read as fast as the detection workers take
+ * their frames: only key frames are decoded, several recordings are decoded
+ * side by side, one per worker, and their frames go through the detection
+ * scheduler like those of live streams, so a SOD model batches them.
+ *
+ * One replay runs at a time, started from the web API or the command line
+ * (lightnvr --replay). Detections are written to the detections table with
+ * the time of their frame, like live ones; replaying a range twice stores
+ * them twice.
+ */
+
+#ifndef LIGHTNVR_DETECTION_REPLAY_H
+#define LIGHTNVR_DETECTION_REPLAY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include "core/config.h"
+
+// What to replay
+typedef struct {
+    char stream_name[MAX_STREAM_NAME];
+    time_t start_time;
+    time_t end_time;
+    char model_path[MAX_PATH_LENGTH];   // Empty for the stream's model; relative to models_path
+    float threshold;                    // 0 for the stream's threshold
+    int interval;                       // Seconds between the key frames detected on (0 = every key frame)
+    bool store;                         // Write the detections to the database
+} detection_replay_request_t;
+
+typedef enum {
+    DETECTION_REPLAY_IDLE = 0,          // No replay since start
+    DETECTION_REPLAY_RUNNING,
+    DETECTION_REPLAY_DONE,
+    DETECTION_REPLAY_CANCELLED,
+    DETECTION_REPLAY_FAILED
+} detection_replay_state_t;
+
+// Progress of the current or last replay
+typedef struct {
+    detection_replay_state_t state;
+    detection_replay_request_t request;
+    int recordings;                     // Recordings read
+    int recordings_failed;              // Recordings that could not be opened
+    uint64_t frames;                    // Frames detected on
+    uint64_t detections;                // Objects found
+    double footage_seconds;             // Recorded time the frames were taken from
+    double elapsed_seconds;             // Time the replay ran
+    char error[128];                    // Why the replay failed
+} detection_replay_status_t;
+
+/**
+ * Start a replay in the background
+ *
+ * @param request What to replay
+ * @param error Receives why the replay did not start (may be NULL)
+ * @param error_size Size of error
+ * @return 0 if started, -1 if a replay is running or the request is invalid
+ */
+int detection_replay_start(const detection_replay_request_t *request, char *error, size_t error_size);
+
+/**
+ * Run a replay and wait for it to finish
+ *
+ * @param request What to replay
+ * @param status Receives the outcome
+ * @return 0 if the replay ran to the end, -1 otherwise
+ */
+int detection_replay_run(const detection_replay_request_t *request, detection_replay_status_t *status);
+
+/**
+ * Get the progress of the current or last replay
+ *
+ * @param status Receives the progress
+ */
+void detection_replay_get_status(detection_replay_status_t *status);
+
+/**
+ * Stop the running replay after the frames in progress
+ */
+void detection_replay_cancel(void);
+
+/**
+ * Stop the running replay and wait for it; called at shutdown
+ */
+void detection_replay_shutdown(void);
+
+/**
+ * Get the name of a replay state
+ *
+ * @param state State
+ * @return "idle", "running", "done", "cancelled" or "failed"
+ */
+const char *detection_replay_state_name(detection_replay_state_t state);
+
+#endif /* LIGHTNVR_DETECTION_REPLAY_H */
@@ -9,6 +9,7 @@ typedef struct {
     char label[MAX_LABEL_LENGTH];  // Object class label
     float confidence;              // Detection confidence (0.0-1.0)
     float x, y, width, height;     // Bounding box (normalized 0.0-1.0)
+    int track_id;                  // Object track the detection belongs to (0 = untracked)
 } detection_t;
 
 // Structure to hold multiple detections from a single frame
@@ -0,0 +1,119 @@
+/**
+ * Detection Scheduler
+ *
+ * A fixed pool of worker threads runs the detection work of every stream:
+ * RGB conversion and model inference. The per-stream threads only demux
+ * and decode the frames they sample, so inference threads no longer scale
+ * with the number of cameras.
+ *
+ * Each stream has a one-deep job slot holding its newest sampled frame; a
+ * newer frame replaces one that has not started yet. Workers serve the
+ * streams round-robin so a busy camera cannot starve the others, and a
+ * global token bucket keeps the total rate under detection_max_fps.
+ *
+ * Background jobs that are not tied to a frame, such as recording
+ * thumbnails, wait in a FIFO and run one at a time on a worker that has no
+ * detection to do, and only while the load governor sheds nothing.
+ */
+
+#ifndef LIGHTNVR_DETECTION_SCHEDULER_H
+#define LIGHTNVR_DETECTION_SCHEDULER_H
+
+#include <stdbool.h>
+#include <time.h>
+#include <libavutil/frame.h>
+
+/**
+ * Detection job callback
+ * Runs on a worker thread. frame is NULL when the job is dropped before it
+ * ran (replaced by a newer frame or cancelled), so the callback can still
+ * clear its bookkeeping.
+ *
+ * @param ctx Context given at submission
+ * @param frame Frame to detect on, or NULL if the job was dropped
+ * @param frame_count Frame number (for logging)
+ * @param timestamp Wall-clock time of the frame
+ */
+typedef void (*detection_job_fn)(void *ctx, const AVFrame *frame, int frame_count, time_t timestamp);
+
+/**
+ * Idle job callback
+ * Runs on a worker thread, or with cancelled set when the scheduler stops
+ * before the job ran. Either way the callback owns ctx and frees it.
+ *
+ * @param ctx Context given at submission
+ * @param cancelled True if the job is dropped instead of run
+ */
+typedef void (*detection_idle_fn)(void *ctx, bool cancelled);
+
+/**
+ * Start the worker threads
+ *
+ * @param workers Number of workers, 0 for one less than the number of cores
+ * @param max_fps Frames per second detected across all streams, 0 for no limit
+ * @return 0 on success, -1 on error
+ */
+int detection_scheduler_init(int workers, int max_fps);
+
+/**
+ * Stop the worker threads, dropping the jobs that have not started
+ */
+void detection_scheduler_shutdown(void);
+
+/**
+ * Queue a frame of a stream for detection
+ * The frame is referenced, so the caller may reuse it immediately.
+ *
+ * @param stream_id Stream registry ID
+ * @param fn Callback running the detection
+ * @param ctx Context passed to the callback
+ * @param frame Frame to detect on
+ * @param frame_count Frame number (for logging)
+ * @param timestamp Wall-clock time of the frame
+ * @return 0 if queued, -1 if the scheduler is not running (run the job inline)
+ */
+int detection_scheduler_submit(int stream_id, detection_job_fn fn, void *ctx, const AVFrame *frame,
+                               int frame_count, time_t timestamp);
+
+/**
+ * Queue a frame and wait until its detection has finished
+ *
+ * @return 0 once the job ran or was dropped, -1 if the scheduler is not running
+ */
+int detection_scheduler_run(int stream_id, detection_job_fn fn, void *ctx, const AVFrame *frame,
+                            int frame_count, time_t timestamp);
+
+/**
+ * Queue a background job for when the workers are idle
+ *
+ * @param fn Callback running the job
+ * @param ctx Context passed to the callback
+ * @return 0 if queued, -1 if the scheduler is not running or the queue is
+ *         full (ctx stays with the caller)
+ */
+int detection_scheduler_submit_idle(detection_idle_fn fn, void *ctx);
+
+/**
+ * Drop the pending job of a stream and wait for its running job
+ * Called before the state the callback uses goes away.
+ *
+ * @param stream_id Stream registry ID
+ */
+void detection_scheduler_cancel(int stream_id);
+
+/**
+ * Number of running workers
+ *
+ * @return Worker count, 0 if the scheduler is not running
+ */
+int detection_scheduler_worker_count(void);
+
+/**
+ * Number of jobs queued or running across all streams
+ * Lets a batched model tell whether waiting for more frames can pay off.
+ *
+ * @return Job count
+ */
+int detection_scheduler_active_jobs(void);
+
+#endif /* LIGHTNVR_DETECTION_SCHEDULER_H */
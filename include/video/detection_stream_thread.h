@@ -4,21 +4,46 @@
 #include <stdbool.h>
 #include <pthread.h>
 #include <stdatomic.h>
+#include <stdint.h>
 #include <time.h>
+#include "core/metrics.h"
+#include "core/pipeline_trace.h"
 #include "video/packet_processor.h" // For MAX_STREAM_NAME definition
 #include "video/detection_model.h"
+#include "video/packet_pool.h"
+#include "video/detection_result.h"
+#include "video/detection_zones.h"
 
-// Maximum number of streams we can handle
-#define MAX_STREAM_THREADS 32
+struct SwsContext;
 
 // Stream detection thread structure
 typedef struct {
     pthread_t thread;
     char stream_name[MAX_STREAM_NAME];
+    int stream_id;                  // Registry ID, also the slot in the thread array
     char model_path[MAX_PATH_LENGTH];
     detection_model_t model;
+    unsigned int model_swap;          // Latest model swap requested, 0 when none
+    char swap_model_path[MAX_PATH_LENGTH]; // Model loading for that swap
+    time_t model_last_used;           // When the model last ran, for idle eviction
+    time_t model_retry_at;            // No reload of an evicted model before then after a failure
     float threshold;
     int detection_interval;
+    int check_interval;               // Adaptive mode: seconds until the next check, follows activity
+    time_t last_check_time;           // Adaptive mode: when a frame was last checked
+    int frame_step;                   // 0 = decode key frames only, N = sample every Nth frame
+    int priority;                     // Stream priority, low ones pause first under load
+    time_t priority_checked;          // When priority was last read back while paused
+    motion_gate_t motion_gate;        // Run the model only on frames (or the region) with motion
+    time_t motion_hold_until;         // Frames keep passing the motion gate until then
+    detection_t motion_region;        // Region of the last motion, normalized
+    bool motion_vectors;              // The decoder exports the motion vectors the motion gate reads
+    detection_zone_t zones[MAX_DETECTION_ZONES]; // Parts of the frame detections must fall in
+    int zone_count;                   // 0 = whole frame
+    packet_pool_t *packet_pool;       // Per-stream pool for decoder packets and frames
+    struct SwsContext *sws_ctx;       // Frame to RGB converter, rebuilt only when the geometry changes
+    uint8_t *rgb_buffer;              // RGB frame the converter writes, reused between frames
+    size_t rgb_buffer_size;
     bool running;
     pthread_mutex_t mutex;
     pthread_cond_t cond;
@@ -26,6 +51,10 @@ typedef struct {
     time_t last_detection_time;
     int component_id;
     atomic_int detection_in_progress; // Atomic flag to track if a detection is currently running
+    metric_t latency_metric;          // Model run time, per stream and model; its count gives the FPS
+    metric_t decode_metric;           // Pipeline latency of live frames out of the decoder
+    metric_t inference_metric;        // Pipeline latency of live frames out of the model
+    pipeline_trace_t live_trace;      // Trace of the live frame handed to detection
 } stream_detection_thread_t;
 
 // Global variable for startup delay
@@ -56,6 +85,44 @@ void shutdown_stream_detection_system(void);
 int start_stream_detection_thread(const char *stream_name, const char *model_path, 
                                  float threshold, int detection_interval, const char *hls_dir);
 
+/**
+ * Apply new detection settings to a running detection thread
+ * The threshold and interval are passed in; sampling mode, priority, motion
+ * gate and zones are read back from the stream configuration. The model and
+ * its input stay as they are, so detection carries on without a gap.
+ *
+ * @param stream_name The name of the stream
+ * @param threshold The detection threshold
+ * @param detection_interval The detection interval in seconds
+ * @return 0 on success, -1 if no detection thread runs for the stream
+ */
+int update_stream_detection_thread(const char *stream_name, float threshold, int detection_interval);
+
+/**
+ * Switch a running detection thread to another model without stopping it
+ * The new model is loaded and warmed up in the background while the thread
+ * keeps detecting with the old one, then replaces it between two detections.
+ * The old model is unloaded once the detection using it has finished. If a
+ * later swap is requested before the load finishes, the later one wins.
+ * Asking for the model the thread already uses, or is already loading, does
+ * nothing.
+ *
+ * @param stream_name The name of the stream
+ * @param model_path The path to the new detection model
+ * @return 0 if the swap was started or is not needed, -1 if no detection
+ *         thread runs for the stream
+ */
+int swap_stream_detection_model(const char *stream_name, const char *model_path);
+
+/**
+ * Unload detection models that have not run for a while
+ * Models unused for model_idle_timeout seconds are unloaded, and while the
+ * loaded models take more than model_memory_budget MB the least recently
+ * used ones are unloaded too. A stream whose model was unloaded loads it
+ * again the next time it has a frame to detect on. Call periodically.
+ */
+void evict_idle_detection_models(void);
+
 /**
  * Stop a detection thread for a stream
  * 
@@ -16,6 +16,45 @@
  */
 bool should_run_detection_check(stream_detection_thread_t *thread, time_t current_time);
 
+/**
+ * Seconds a stream currently waits between detection checks
+ * The stream's detection_interval, or in adaptive mode the interval its
+ * recent activity has set, within [models] detection_interval_min/max.
+ * Doubled while the load governor sheds detection.
+ */
+int detection_check_interval(const stream_detection_thread_t *thread);
+
+/**
+ * Check whether the detection interval has passed since the last check
+ */
+bool detection_interval_elapsed(const stream_detection_thread_t *thread, time_t now);
+
+/**
+ * Whether the load governor has paused detection on a stream
+ * Only streams below [load_shedding] pause_priority pause, at the last step.
+ */
+bool detection_paused_by_load(stream_detection_thread_t *thread, time_t now);
+
+/**
+ * Sampling mode a stream currently decodes in
+ * Falls back to key frames only while the load governor sheds decoding.
+ *
+ * @return 0 for key frames only, N for every Nth frame
+ */
+int detection_frame_step(const stream_detection_thread_t *thread);
+
+/**
+ * Adapt the detection interval to the outcome of a check
+ * A check that found motion or objects puts the stream back at the minimum
+ * interval, a quiet one doubles the interval up to the maximum. Does
+ * nothing unless the adaptive interval is enabled.
+ *
+ * @param thread Detection thread
+ * @param now Time of the check
+ * @param active Whether the check found motion or objects
+ */
+void update_detection_interval(stream_detection_thread_t *thread, time_t now, bool active);
+
 /**
  * Check and manage HLS writer status
  * Returns true if HLS writer is recording, false otherwise
@@ -0,0 +1,79 @@
+/**
+ * Detection Zones
+ *
+ * A stream may restrict object detection to a few polygons of the frame
+ * (a door, a driveway, a fence line). The model only sees the bounding box
+ * of the zones, and detections whose foot point falls outside every zone
+ * are dropped before they are stored.
+ *
+ * Zones are stored as text: polygons separated by '|', vertices separated
+ * by spaces, each vertex "x,y" in normalized (0-1) frame coordinates. A
+ * polygon of two vertices is the rectangle with those opposite corners:
+ *
+ *   "0.1,0.5 0.4,0.5 0.4,1 0.1,1 | 0.6,0.2 0.9,0.6"
+ */
+
+#ifndef LIGHTNVR_DETECTION_ZONES_H
+#define LIGHTNVR_DETECTION_ZONES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "core/config.h"
+#include "video/detection_result.h"
+
+// Zones of one stream
+#define MAX_DETECTION_ZONES 4
+// Vertices of one zone
+#define MAX_ZONE_POINTS 8
+
+// Polygon with normalized vertices
+typedef struct {
+    int point_count;
+    float x[MAX_ZONE_POINTS];
+    float y[MAX_ZONE_POINTS];
+} detection_zone_t;
+
+/**
+ * Parse the text form of a stream's zones
+ *
+ * @param text Zones text, empty or NULL for none
+ * @param zones Receives the zones
+ * @param max_zones Capacity of zones
+ * @return Number of zones (0 means the whole frame), -1 if the text is invalid
+ */
+int parse_detection_zones(const char *text, detection_zone_t *zones, int max_zones);
+
+/**
+ * Write zones in their text form
+ *
+ * @param zones Zones
+ * @param count Number of zones
+ * @param text Receives the text
+ * @param size Size of text (MAX_DETECTION_ZONES_TEXT holds any valid zones)
+ * @return 0 on success, -1 if the text does not fit
+ */
+int format_detection_zones(const detection_zone_t *zones, int count, char *text, size_t size);
+
+/**
+ * Bounding box of all zones
+ *
+ * @param zones Zones
+ * @param count Number of zones
+ * @param bounds Receives the box, normalized
+ * @return true if there are zones, false if the whole frame is used
+ */
+bool detection_zones_bounds(const detection_zone_t *zones, int count, detection_t *bounds);
+
+/**
+ * Drop detections whose foot point (middle of the bottom edge, where the
+ * object stands) lies outside every zone
+ *
+ * @param zones Zones
+ * @param count Number of zones, 0 keeps every detection
+ * @param result Detections, filtered in place
+ * @return Number of detections dropped
+ */
+int filter_detections_by_zones(const detection_zone_t *zones, int count, detection_result_t *result);
+
+#endif /* LIGHTNVR_DETECTION_ZONES_H */
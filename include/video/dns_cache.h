@@ -0,0 +1,66 @@
+/**
+ * Camera host name cache
+ *
+ * Cameras given by host name would otherwise be resolved again by FFmpeg or
+ * curl on every reconnect, which stalls each reconnect for as long as a slow
+ * or flaky DNS server takes to answer.
+ *
+ * A host is resolved the first time it is looked up. After that a background
+ * thread refreshes it before its entry goes stale, so lookups are answered
+ * from memory. If a refresh fails the last good address is kept, and hosts
+ * not looked up for a while are dropped.
+ */
+
+#ifndef LIGHTNVR_DNS_CACHE_H
+#define LIGHTNVR_DNS_CACHE_H
+
+#include <stddef.h>
+
+/**
+ * Start the background refresh thread
+ * Lookups work without it, but entries are then only refreshed by lookups.
+ *
+ * @return 0 on success, -1 on error
+ */
+int dns_cache_start(void);
+
+/**
+ * Stop the background refresh thread
+ */
+void dns_cache_stop(void);
+
+/**
+ * Look up the address of a host
+ * Numeric addresses are returned as they are. IPv4 addresses are preferred.
+ *
+ * @param host Host name
+ * @param addr Buffer receiving the numeric address
+ * @param size Size of the buffer
+ * @return 0 on success, -1 if the host could not be resolved
+ */
+int dns_cache_lookup(const char *host, char *addr, size_t size);
+
+/**
+ * Replace the host name of a URL with its cached address
+ * Only done for schemes without TLS, where the name is not needed to check
+ * the server's certificate. The URL is copied unchanged otherwise.
+ *
+ * @param url URL to resolve
+ * @param out Buffer receiving the URL
+ * @param size Size of the buffer
+ * @return 0 if the host was replaced, -1 if the URL was copied unchanged
+ */
+int dns_cache_resolve_url(const char *url, char *out, size_t size);
+
+/**
+ * Format a curl CURLOPT_RESOLVE entry, "host:port:address", for a URL
+ * Lets curl skip resolving the host while keeping its name for TLS.
+ *
+ * @param url URL curl is about to request
+ * @param entry Buffer receiving the entry
+ * @param size Size of the buffer
+ * @return 0 on success, -1 if the URL has no host name that needs resolving
+ */
+int dns_cache_curl_entry(const char *url, char *entry, size_t size);
+
+#endif /* LIGHTNVR_DNS_CACHE_H */
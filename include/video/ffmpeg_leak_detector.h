@@ -5,6 +5,13 @@
 #include <libavcodec/avcodec.h>
 #include <libavutil/avutil.h>
 
+/*
+ * Tracked objects are kept in a hash table together with the name of the
+ * thread that opened them, so tracking costs a lookup per open and close and
+ * can stay on for the life of the process. Live, opened and closed counts by
+ * type are exported as metrics.
+ */
+
 /**
  * Initialize the FFmpeg leak detector
  * This should be called during application startup
@@ -48,6 +55,14 @@ int ffmpeg_get_allocation_count(void);
  */
 void ffmpeg_dump_allocations(void);
 
+/**
+ * Check for threads holding more tracked objects of one type than a stream
+ * needs, which points at a close path that misses its untrack, and log them
+ *
+ * @return Number of thread and type pairs over the limit
+ */
+int ffmpeg_leak_detector_check(void);
+
 /**
  * Force cleanup of all tracked allocations
  * This is a last resort to prevent memory leaks
@@ -38,18 +38,6 @@ void safe_avformat_cleanup(AVFormatContext **ctx_ptr);
  */
 void safe_packet_cleanup(AVPacket **pkt_ptr);
 
-/**
- * Periodic FFmpeg resource reset
- * This function performs a periodic reset of FFmpeg resources to prevent memory growth
- * It should be called periodically during long-running operations
- *
- * @param input_ctx_ptr Pointer to the AVFormatContext pointer to reset
- * @param url The URL to reopen after reset
- * @param protocol The protocol to use (TCP/UDP)
- * @return 0 on success, negative value on error
- */
-int periodic_ffmpeg_reset(AVFormatContext **input_ctx_ptr, const char *url, int protocol);
-
 /**
  * Perform comprehensive cleanup of FFmpeg resources
  * This function ensures all resources associated with an AVFormatContext are properly freed
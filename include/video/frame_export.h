@@ -0,0 +1,88 @@
+/**
+ * Shared-Memory Frame Export
+ *
+ * Publishes the frames the detection threads decode, downscaled to RGB24,
+ * in a POSIX shared-memory ring per stream, so external analytics (plate
+ * readers and the like) can read them in place instead of opening their own
+ * RTSP session and decoding the stream again. Results go back through
+ * POST /api/detection/results/<stream>.
+ *
+ * The segment of a stream is /dev/shm/lightnvr-frames-<stream>, with every
+ * character of the stream name outside [A-Za-z0-9_-] replaced by '_'. It
+ * starts with a frame_export_header_t, followed by the slot data at
+ * data_offset, slot i at data_offset + i * slot_size. All fields are in host
+ * byte order.
+ *
+ * Reading the newest frame:
+ *   1. seq = frame_seq (acquire); frames published so far, 0 if none
+ *   2. slot = slots[(seq - 1) % slot_count]
+ *   3. s = slot.seq (acquire); odd means the slot is being written, retry
+ *   4. use the pixels and the slot fields
+ *   5. if slot.seq (acquire) != s, the frame was overwritten meanwhile
+ * To wait for the next frame, FUTEX_WAIT (not the private variant) on
+ * frame_seq with the value last seen; every publish wakes all waiters.
+ */
+
+#ifndef LIGHTNVR_FRAME_EXPORT_H
+#define LIGHTNVR_FRAME_EXPORT_H
+
+#include <stdint.h>
+
+#define FRAME_EXPORT_MAGIC 0x4C4E5646u   // 'LNVF'
+#define FRAME_EXPORT_VERSION 1
+#define FRAME_EXPORT_FORMAT_RGB24 1
+#define FRAME_EXPORT_MAX_SLOTS 16
+
+struct AVFrame;
+
+// One frame of the ring
+typedef struct {
+    uint32_t seq;                // Even when stable, odd while the writer fills the slot
+    uint32_t width;              // Frame width in pixels
+    uint32_t height;             // Frame height in pixels
+    uint32_t stride;             // Bytes between rows
+    int64_t timestamp_ms;        // Wall-clock time the frame was decoded, ms since the epoch
+    uint64_t frame_number;       // Frames published before this one
+} frame_export_slot_t;
+
+// Start of the shared-memory segment
+typedef struct {
+    uint32_t magic;              // FRAME_EXPORT_MAGIC
+    uint32_t version;            // FRAME_EXPORT_VERSION
+    uint32_t format;             // FRAME_EXPORT_FORMAT_RGB24
+    uint32_t slot_count;         // Frames in the ring
+    uint32_t max_width;          // Largest frame a slot holds
+    uint32_t max_height;
+    uint64_t slot_size;          // Bytes per slot
+    uint64_t data_offset;        // Offset of slot 0's pixels from the segment start
+    uint32_t frame_seq;          // Frames published; futex word
+    uint32_t writer_pid;         // Process publishing the frames
+    uint32_t reserved[6];
+    frame_export_slot_t slots[FRAME_EXPORT_MAX_SLOTS];
+} frame_export_header_t;
+
+/**
+ * Publish a decoded frame of a stream, if [frame_export] covers the stream
+ * The frame is scaled to fit in max_size x max_size straight into the next
+ * slot of the ring; the segment is created on the first frame.
+ *
+ * @param stream_name Stream the frame belongs to
+ * @param frame Decoded software frame
+ * @return 0 on success or when the stream is not exported, -1 on failure
+ */
+int frame_export_publish(const char *stream_name, const struct AVFrame *frame);
+
+/**
+ * Stop exporting a stream and remove its segment
+ * Readers keep their mapping until they unmap it.
+ *
+ * @param stream_name Stream name
+ */
+void frame_export_close(const char *stream_name);
+
+/**
+ * Remove the segments of all streams
+ */
+void frame_export_shutdown(void);
+
+#endif /* LIGHTNVR_FRAME_EXPORT_H */
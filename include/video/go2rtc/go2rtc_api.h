@@ -8,6 +8,7 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <curl/curl.h>
 
 /**
  * @brief Initialize the go2rtc API client
@@ -68,6 +69,19 @@ bool go2rtc_api_update_config(void);
  */
 bool go2rtc_api_get_server_info(int *rtsp_port);
 
+/**
+ * @brief Get the calling thread's curl handle for requests to go2rtc
+ *
+ * The handle is reset on every call but keeps its connection cache, so
+ * consecutive requests from one thread reuse a keep-alive connection to
+ * go2rtc instead of opening a new one each time. It is freed when the
+ * thread exits; callers must not clean it up, nor use it after the next
+ * call from the same thread.
+ *
+ * @return CURL* Handle, or NULL if it could not be created
+ */
+CURL *go2rtc_api_get_curl(void);
+
 /**
  * @brief Clean up resources used by the go2rtc API client
  */
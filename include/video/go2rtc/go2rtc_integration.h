@@ -51,6 +51,9 @@ int go2rtc_integration_stop_hls(const char *stream_name);
 /**
  * @brief Check if a stream is using go2rtc for recording
  *
+ * Always true with go2rtc_upstream set, which routes every consumer through
+ * go2rtc's restream of the camera.
+ *
  * @param stream_name Name of the stream to check
  * @return true if using go2rtc, false otherwise
  */
@@ -59,6 +62,8 @@ bool go2rtc_integration_is_using_go2rtc_for_recording(const char *stream_name);
 /**
  * @brief Check if a stream is using go2rtc for HLS streaming
  *
+ * Always true with go2rtc_upstream set, as for recording.
+ *
  * @param stream_name Name of the stream to check
  * @return true if using go2rtc, false otherwise
  */
@@ -8,6 +8,15 @@
 
 #include <stdbool.h>
 
+// Time to wait for go2rtc to start listening
+#define GO2RTC_READY_TIMEOUT_MS 10000
+
+// Interval for polling the API of a go2rtc we did not start
+#define GO2RTC_READY_POLL_MS 100
+
+// Time to wait for go2rtc to exit after SIGTERM
+#define GO2RTC_STOP_TIMEOUT_MS 5000
+
 /**
  * @brief Initialize the go2rtc process manager
  * 
@@ -25,6 +34,18 @@ bool go2rtc_process_init(const char *binary_path, const char *config_dir);
  */
 bool go2rtc_process_start(int api_port);
 
+/**
+ * @brief Wait for go2rtc to be ready for API requests
+ *
+ * For a go2rtc we started, this waits until it reports its API listening
+ * and returns as soon as it does, or as soon as the process exits. For an
+ * existing service the API is polled instead.
+ *
+ * @param timeout_ms Maximum time to wait
+ * @return true if go2rtc is ready, false otherwise
+ */
+bool go2rtc_process_wait_ready(int timeout_ms);
+
 /**
  * @brief Stop the go2rtc process
  * 
@@ -48,6 +69,34 @@ bool go2rtc_process_is_running(void);
  */
 bool go2rtc_process_generate_config(const char *config_path, int api_port);
 
+/**
+ * @brief Set the streams to write into the config when go2rtc is launched
+ *
+ * go2rtc loads these at startup, so they need no API request each.
+ *
+ * @param names Stream names
+ * @param sources Source URLs as they would be registered through the API
+ * @param count Number of streams
+ * @return true on success, false if memory could not be allocated
+ */
+bool go2rtc_process_set_config_streams(const char *const *names, const char *const *sources, int count);
+
+/**
+ * @brief Check if the running go2rtc loaded a stream from its config
+ *
+ * @param name Stream name
+ * @param source Source URL
+ * @return true if go2rtc was launched by us with this stream and source
+ */
+bool go2rtc_process_config_has_stream(const char *name, const char *source);
+
+/**
+ * @brief Forget a config stream after it was removed through the API
+ *
+ * @param name Stream name
+ */
+void go2rtc_process_forget_config_stream(const char *name);
+
 /**
  * @brief Clean up resources used by the go2rtc process manager
  */
@@ -0,0 +1,136 @@
+/**
+ * Generation-counted Handle Table
+ *
+ * Fixed-size table mapping small integer handles to thread contexts. A handle
+ * combines a slot index with the generation of the slot when it was handed
+ * out; releasing the slot bumps the generation, so every copy of the old
+ * handle becomes invalid at once, even if the slot or the memory behind the
+ * pointer is reused later.
+ *
+ * Each slot keeps its generation and a small set of flags in one atomic word,
+ * so validity checks and flag updates are single lock-free loads or CAS loops
+ * and never dereference the context. Threads can therefore keep checking their
+ * own handle after the owner has freed the context.
+ *
+ * A zero-initialized table is empty and ready to use.
+ */
+
+#ifndef LIGHTNVR_HANDLE_TABLE_H
+#define LIGHTNVR_HANDLE_TABLE_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Slots per table
+#define HANDLE_TABLE_SLOTS 64
+
+// Never returned by handle_table_insert
+#define HANDLE_INVALID ((handle_t)0)
+
+/**
+ * Handle: generation in the upper 32 bits, slot index in the lower 32 bits
+ */
+typedef uint64_t handle_t;
+
+/**
+ * Table slot
+ * state holds the generation in the upper 32 bits (odd while the slot is
+ * allocated) and the caller-defined flags in the lower 32 bits.
+ */
+typedef struct {
+    atomic_uint_fast64_t state;
+    _Atomic(void *) ptr;
+} handle_slot_t;
+
+typedef struct {
+    handle_slot_t slots[HANDLE_TABLE_SLOTS];
+} handle_table_t;
+
+/**
+ * Allocate a handle for a pointer
+ *
+ * @param table Handle table
+ * @param ptr Pointer to register (flags start cleared)
+ * @return New handle, or HANDLE_INVALID if the table is full
+ */
+handle_t handle_table_insert(handle_table_t *table, void *ptr);
+
+/**
+ * Invalidate a handle and free its slot
+ *
+ * @param table Handle table
+ * @param handle Handle to release
+ * @return 0 on success, -1 if the handle was already invalid
+ */
+int handle_table_release(handle_table_t *table, handle_t handle);
+
+/**
+ * Check whether a handle is still valid
+ *
+ * @param table Handle table
+ * @param handle Handle to check
+ * @return true if the handle has not been released
+ */
+bool handle_table_is_valid(handle_table_t *table, handle_t handle);
+
+/**
+ * Get the pointer registered for a handle
+ *
+ * @param table Handle table
+ * @param handle Handle to resolve
+ * @return Registered pointer, or NULL if the handle is invalid
+ */
+void *handle_table_get(handle_table_t *table, handle_t handle);
+
+/**
+ * Set flags on a handle
+ *
+ * @param table Handle table
+ * @param handle Handle to update
+ * @param flags Flags to set
+ * @return 0 on success, -1 if the handle is invalid
+ */
+int handle_table_set_flags(handle_table_t *table, handle_t handle, uint32_t flags);
+
+/**
+ * Clear flags on a handle
+ *
+ * @param table Handle table
+ * @param handle Handle to update
+ * @param flags Flags to clear
+ * @return 0 on success, -1 if the handle is invalid
+ */
+int handle_table_clear_flags(handle_table_t *table, handle_t handle, uint32_t flags);
+
+/**
+ * Get the flags of a handle
+ *
+ * @param table Handle table
+ * @param handle Handle to query
+ * @param flags Receives the flags
+ * @return 0 on success, -1 if the handle is invalid
+ */
+int handle_table_get_flags(handle_table_t *table, handle_t handle, uint32_t *flags);
+
+/**
+ * Get the handle currently allocated in a slot
+ * Used to walk the table; the result may be released concurrently.
+ *
+ * @param table Handle table
+ * @param index Slot index (0 to HANDLE_TABLE_SLOTS - 1)
+ * @return Handle, or HANDLE_INVALID if the slot is free
+ */
+handle_t handle_table_handle_at(handle_table_t *table, int index);
+
+/**
+ * Find the handle registered for a pointer
+ * Linear scan for callers that only hold the pointer; prefer keeping the handle.
+ *
+ * @param table Handle table
+ * @param ptr Registered pointer
+ * @return Handle, or HANDLE_INVALID if the pointer is not registered
+ */
+handle_t handle_table_find(handle_table_t *table, const void *ptr);
+
+#endif /* LIGHTNVR_HANDLE_TABLE_H */
@@ -0,0 +1,75 @@
+#ifndef HLS_ABR_H
+#define HLS_ABR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Adaptive bitrate renditions of live HLS
+ *
+ * With [storage] hls_abr_renditions, a stream can also be watched at lower
+ * resolutions. Renditions are transcoded only while they are watched: the
+ * first request for one starts the stream's transcoder, which attaches to the
+ * shared ingest, decodes the camera once and encodes each watched rendition
+ * on the hardware encoder when there is one (see stream_transcoding.h). A
+ * rendition stops after hls_idle_timeout seconds without requests, and the
+ * transcoder once no rendition is left.
+ *
+ * HEVC streams also get an H.264 rendition at their own height when
+ * [hardware] transcode_hevc is enabled, for browsers that cannot play HEVC.
+ *
+ * The master playlist, /hls/<stream>/master.m3u8, lists the stream's own HLS
+ * output followed by the renditions below its height. Rendition <h> is
+ * written as MPEG-TS HLS to /hls/<stream>/<h>p/.
+ */
+
+#define HLS_ABR_MAX_RENDITIONS 4
+#define HLS_ABR_MASTER_PLAYLIST "master.m3u8"
+
+/**
+ * Get the configured rendition heights, highest first
+ *
+ * @param heights Receives the heights
+ * @param max Size of the array
+ * @return Number of renditions, 0 when ABR is disabled
+ */
+int hls_abr_get_renditions(int *heights, int max);
+
+/**
+ * Split an HLS file name of a rendition, e.g. "360p/index.m3u8"
+ *
+ * @param file_name File name relative to the stream's HLS directory
+ * @param height Receives the rendition height
+ * @return Name of the file in the rendition directory, or NULL if the file
+ *         name is not one of a rendition
+ */
+const char *hls_abr_parse_path(const char *file_name, int *height);
+
+/**
+ * Count a request for a rendition, starting its transcoding if needed
+ *
+ * @param stream_name Name of the stream
+ * @param height Rendition height
+ * @return 0 if the rendition is being written, 1 if it is starting, -1 if the
+ *         stream has no such rendition or no running HLS thread
+ */
+int hls_abr_request(const char *stream_name, int height);
+
+/**
+ * Write the master playlist of a stream
+ *
+ * @param stream_name Name of the stream
+ * @param buf Buffer receiving the playlist
+ * @param size Size of the buffer
+ * @return Length of the playlist, -1 if it does not fit
+ */
+int hls_abr_build_master_playlist(const char *stream_name, char *buf, size_t size);
+
+/**
+ * Stop the transcoder of a stream and wait for it to finish
+ *
+ * @param stream_name Name of the stream
+ */
+void hls_abr_stop(const char *stream_name);
+
+#endif /* HLS_ABR_H */
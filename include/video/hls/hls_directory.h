@@ -7,6 +7,22 @@
  */
 void cleanup_hls_directories(void);
 
+/**
+ * Start the worker that deletes stale HLS directories in the background
+ * Stream directories being cleared are renamed into <hls>/.deleted, so
+ * starting and stopping streams never waits on deleting files; the worker
+ * empties that directory with idle I/O priority, beginning with whatever an
+ * earlier run left there.
+ *
+ * @return 0 on success, -1 on error
+ */
+int start_hls_cleanup_worker(void);
+
+/**
+ * Stop the cleanup worker; what it has not deleted yet is deleted after the next start
+ */
+void stop_hls_cleanup_worker(void);
+
 /**
  * Ensure the HLS output directory exists and is writable
  * 
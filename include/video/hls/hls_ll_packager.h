@@ -0,0 +1,114 @@
+#ifndef HLS_LL_PACKAGER_H
+#define HLS_LL_PACKAGER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <libavformat/avformat.h>
+#include <libavutil/buffer.h>
+
+/**
+ * Low-Latency HLS packager
+ *
+ * Remuxes the packets of the HLS writer into fragmented MP4 and cuts every
+ * fragment into a partial segment of about hls_part_duration milliseconds.
+ * Parts are grouped into segments that start on a keyframe. Everything is
+ * kept in memory and the media playlist is generated on request, with
+ * EXT-X-PART and EXT-X-PRELOAD-HINT tags so players can start on the newest
+ * part instead of waiting for complete segments.
+ *
+ * Resource names, relative to /hls/{stream}/:
+ *   ll_init.mp4          Initialization section (EXT-X-MAP)
+ *   ll_part_{n}.m4s      Partial segment, numbered across segments
+ *   ll_segment_{msn}.m4s Complete segment, the concatenation of its parts
+ */
+
+#define HLS_LL_INIT_NAME "ll_init.mp4"
+
+typedef struct hls_ll_packager hls_ll_packager_t;
+
+/**
+ * Create a packager for a stream and publish its initialization section
+ *
+ * @param stream_name Name of the stream
+ * @param stream Stream whose packets are passed to hls_ll_packager_write_packet
+ * @param segment_duration Target segment duration in seconds
+ * @param part_duration_ms Target part duration in milliseconds
+ * @return Packager, or NULL on error
+ */
+hls_ll_packager_t *hls_ll_packager_create(const char *stream_name, const AVStream *stream,
+                                          int segment_duration, int part_duration_ms);
+
+/**
+ * Add a packet, publishing the current part first if the packet starts a new one
+ * The packet is not modified.
+ *
+ * @param packager Packager
+ * @param pkt Packet
+ * @param time_base Time base of the packet timestamps
+ * @return 0 on success, -1 on error
+ */
+int hls_ll_packager_write_packet(hls_ll_packager_t *packager, const AVPacket *pkt, AVRational time_base);
+
+/**
+ * Stop publishing the stream and free the packager
+ *
+ * @param packager Packager
+ */
+void hls_ll_packager_destroy(hls_ll_packager_t *packager);
+
+/**
+ * Check whether a stream is published by a packager
+ *
+ * @param stream_name Name of the stream
+ * @return true if the stream has a packager
+ */
+bool hls_ll_is_active(const char *stream_name);
+
+/**
+ * Check whether the playlist contains a part, for blocking playlist reloads
+ *
+ * @param stream_name Name of the stream
+ * @param msn Media sequence number of the segment (_HLS_msn)
+ * @param part Index of the part in the segment (_HLS_part), or -1 to wait for the whole segment
+ * @return 1 if the playlist contains it, 0 if not yet, -1 if it is too far ahead or the stream is inactive
+ */
+int hls_ll_playlist_ready(const char *stream_name, int64_t msn, int part);
+
+/**
+ * Check whether a part has been published, for preload hint requests
+ *
+ * @param stream_name Name of the stream
+ * @param sequence Number of the part
+ * @return 1 if published, 0 if it is the next part, -1 if it is too far ahead or the stream is inactive
+ */
+int hls_ll_part_ready(const char *stream_name, int64_t sequence);
+
+/**
+ * Get how long a blocking request may be held
+ *
+ * @param stream_name Name of the stream
+ * @return Three target durations, in milliseconds
+ */
+int hls_ll_block_timeout_ms(const char *stream_name);
+
+/**
+ * Generate the media playlist of a stream
+ *
+ * @param stream_name Name of the stream
+ * @param length Receives the length of the playlist
+ * @return Playlist to release with free, or NULL if no segment is complete yet
+ */
+char *hls_ll_build_playlist(const char *stream_name, size_t *length);
+
+/**
+ * Get the initialization section, a part or a segment of a stream
+ *
+ * @param stream_name Name of the stream
+ * @param file_name Resource name
+ * @param data Receives a new reference to the data; release it with av_buffer_unref
+ * @return 0 on success, -1 if the resource is not available
+ */
+int hls_ll_get_resource(const char *stream_name, const char *file_name, AVBufferRef **data);
+
+#endif /* HLS_LL_PACKAGER_H */
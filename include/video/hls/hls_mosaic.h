@@ -0,0 +1,54 @@
+#ifndef HLS_MOSAIC_H
+#define HLS_MOSAIC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Multi-camera mosaic stream
+ *
+ * With [storage] hls_mosaic_streams, the listed streams are tiled into one
+ * grid and served as live HLS under a virtual stream name,
+ * /hls/<hls_mosaic_name>/index.m3u8. A camera wall then costs a client one
+ * stream to download and decode instead of one per camera.
+ *
+ * The mosaic starts with the first request and stops hls_idle_timeout seconds
+ * after the last one. Each tile has a thread that attaches to its stream's
+ * shared ingest and decodes it, keeping only the latest picture scaled to the
+ * tile; a compositor thread copies the tiles into the grid hls_mosaic_fps
+ * times a second and encodes it on the hardware encoder when there is one
+ * (see stream_transcoding.h).
+ */
+
+#define HLS_MOSAIC_MAX_TILES 16
+
+/**
+ * Check whether a stream name is the mosaic's
+ *
+ * @param stream_name Name taken from an HLS URL
+ * @return true if the mosaic is enabled and served under this name
+ */
+bool hls_mosaic_is_name(const char *stream_name);
+
+/**
+ * Count a request for the mosaic, starting it if needed
+ *
+ * @return 0 if the mosaic is being written, 1 if it is starting, -1 if it is
+ *         disabled or cannot be started
+ */
+int hls_mosaic_request(void);
+
+/**
+ * Get the directory the mosaic's playlist and segments are written to
+ *
+ * @param dir Buffer receiving the path
+ * @param size Size of the buffer
+ */
+void hls_mosaic_get_dir(char *dir, size_t size);
+
+/**
+ * Stop the mosaic and wait for its threads to finish
+ */
+void hls_mosaic_stop(void);
+
+#endif /* HLS_MOSAIC_H */
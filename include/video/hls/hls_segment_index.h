@@ -0,0 +1,132 @@
+#ifndef HLS_SEGMENT_INDEX_H
+#define HLS_SEGMENT_INDEX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <libavutil/buffer.h>
+
+#include "core/config.h"
+
+/**
+ * In-memory index of the live HLS segments of each stream
+ *
+ * The HLS writer records every segment it completes, so the cleanup, the
+ * detection fallback and the web handlers can find segments without
+ * opendir/readdir/stat walks over the HLS directory. The index only keeps as
+ * many segments as the writer leaves on disk; a segment that is not in the
+ * index of an active stream is either still being written or already deleted.
+ *
+ * Streams whose HLS output is not produced by our writer (e.g. go2rtc) have no
+ * active index, and callers fall back to the filesystem.
+ *
+ * With hls_memory_store enabled the writer keeps segment data in the index
+ * instead of on disk. The data is reference counted, so a segment that is
+ * being sent stays valid after the writer drops it from the index.
+ */
+
+// Most segments kept per stream
+#define HLS_SEGMENT_INDEX_SIZE 16
+
+/**
+ * Completed HLS segment
+ */
+typedef struct {
+    char path[MAX_PATH_LENGTH];
+    int64_t sequence;           // Media sequence number of the segment
+    double duration;            // Duration in seconds
+    int64_t size;               // Size in bytes
+    int64_t keyframe_pts;       // PTS of the keyframe starting the segment, 90 kHz
+    time_t completed_time;      // When the writer closed the segment
+} hls_segment_info_t;
+
+/**
+ * Start indexing the segments of a stream
+ * Replaces the index of a previous writer for the same stream.
+ *
+ * @param stream_name Name of the stream
+ * @param directory Directory the segments are written to
+ * @param retain Number of completed segments kept on disk (1 to HLS_SEGMENT_INDEX_SIZE)
+ * @param owner Writer owning the index, passed back to add and close
+ * @return 0 on success, -1 on error
+ */
+int hls_segment_index_open(const char *stream_name, const char *directory, int retain, const void *owner);
+
+/**
+ * Stop indexing the segments of a stream and wake up waiting readers
+ * Does nothing if the index has been taken over by another owner.
+ *
+ * @param stream_name Name of the stream
+ * @param owner Owner passed to hls_segment_index_open
+ */
+void hls_segment_index_close(const char *stream_name, const void *owner);
+
+/**
+ * Record a completed segment and wake up waiting readers
+ * The oldest segment is dropped once more than retain segments are indexed.
+ *
+ * @param stream_name Name of the stream
+ * @param owner Owner passed to hls_segment_index_open
+ * @param segment Completed segment
+ * @param data Segment data kept in memory, or NULL if the segment is on disk;
+ *             the index takes over the reference, also on error
+ * @return 0 on success, -1 if the stream has no index owned by owner
+ */
+int hls_segment_index_add(const char *stream_name, const void *owner, const hls_segment_info_t *segment,
+                          AVBufferRef *data);
+
+/**
+ * Check whether the segments of a stream are indexed
+ *
+ * @param stream_name Name of the stream
+ * @return true if an HLS writer maintains the index of the stream
+ */
+bool hls_segment_index_is_active(const char *stream_name);
+
+/**
+ * Get the newest completed segment of a stream
+ *
+ * @param stream_name Name of the stream
+ * @param segment Receives the segment
+ * @param count Receives the number of indexed segments (may be NULL)
+ * @return 0 on success, -1 if the index is inactive or empty
+ */
+int hls_segment_index_get_latest(const char *stream_name, hls_segment_info_t *segment, int *count);
+
+/**
+ * Find an indexed segment by file name
+ *
+ * @param stream_name Name of the stream
+ * @param file_name File name of the segment, without directory
+ * @param segment Receives the segment (may be NULL)
+ * @param data Receives a new reference to the segment data, or NULL if the
+ *             segment is on disk; release it with av_buffer_unref (may be NULL)
+ * @return 0 if found, -1 otherwise
+ */
+int hls_segment_index_find(const char *stream_name, const char *file_name, hls_segment_info_t *segment,
+                           AVBufferRef **data);
+
+/**
+ * Get the directory the segments of a stream are written to
+ *
+ * @param stream_name Name of the stream
+ * @param directory Buffer receiving the directory
+ * @param size Size of the buffer
+ * @return 0 on success, -1 if the index is inactive
+ */
+int hls_segment_index_get_directory(const char *stream_name, char *directory, size_t size);
+
+/**
+ * Wait until a segment newer than a sequence number is completed
+ *
+ * @param stream_name Name of the stream
+ * @param after_sequence Sequence number already seen (-1 for any segment)
+ * @param timeout_ms Longest wait in milliseconds
+ * @param segment Receives the newest segment (may be NULL)
+ * @return 0 if a newer segment is available, -1 on timeout or if the index is inactive
+ */
+int hls_segment_index_wait(const char *stream_name, int64_t after_sequence, int timeout_ms,
+                           hls_segment_info_t *segment);
+
+#endif /* HLS_SEGMENT_INDEX_H */
@@ -5,8 +5,10 @@
 #include <stdatomic.h>
 #include <libavformat/avformat.h>
 #include "core/config.h"
+#include "video/handle_table.h"
 #include "video/hls_writer.h"
 #include "video/stream_protocol.h"
+#include "video/stream_supervisor.h"
 
 // Stream thread state constants
 typedef enum {
@@ -14,6 +16,7 @@ typedef enum {
     HLS_THREAD_CONNECTING,
     HLS_THREAD_RUNNING,
     HLS_THREAD_RECONNECTING,
+    HLS_THREAD_IDLE,         // On demand, detached from the ingest until the next viewer
     HLS_THREAD_STOPPING,
     HLS_THREAD_STOPPED
 } hls_thread_state_t;
@@ -32,16 +35,22 @@ typedef struct {
     pthread_t thread;
     atomic_int running;
     int shutdown_component_id;
+    handle_t handle;  // Slot in the context handle table, checked instead of the pointer
 
     // Stream configuration
     int protocol;  // STREAM_PROTOCOL_TCP or STREAM_PROTOCOL_UDP
     int segment_duration;
+    hls_segment_format_t segment_format;
+    bool record_segments;    // Keep the HLS segments as the recording (hls_recording)
+    int recording_duration;  // Seconds per recording, the stream's segment_duration
+    bool on_demand;          // Only write while the stream is watched (hls_on_demand)
 
     // HLS writer (embedded directly instead of pointer)
     hls_writer_t *writer;
 
     // Connection state tracking
     atomic_int_fast64_t last_packet_time;
+    supervised_t *heartbeat;  // Beaten for every packet, see stream_supervisor.h
     atomic_int connection_valid;
     atomic_int consecutive_failures;
     atomic_int thread_state;  // Uses hls_thread_state_t values
@@ -87,6 +96,17 @@ int restart_hls_stream(const char *stream_name);
  */
 int is_hls_stream_active(const char *stream_name);
 
+/**
+ * Get the input of a running HLS thread, to attach to the same shared ingest
+ *
+ * @param stream_name The name of the stream
+ * @param url Buffer receiving the input URL
+ * @param url_size Size of the buffer
+ * @param protocol Receives STREAM_PROTOCOL_TCP or STREAM_PROTOCOL_UDP
+ * @return 0 on success, -1 if no HLS thread runs for the stream
+ */
+int get_hls_stream_input(const char *stream_name, char *url, size_t url_size, int *protocol);
+
 /**
  * Thread function for the unified HLS thread
  * This function handles all HLS streaming operations for a single stream
@@ -0,0 +1,80 @@
+#ifndef HLS_VIEWERS_H
+#define HLS_VIEWERS_H
+
+#include <stdbool.h>
+
+#include "core/config.h"
+
+/**
+ * Viewers of on-demand live HLS
+ *
+ * With hls_on_demand, the HLS thread of a stream only writes segments while
+ * someone watches: every request for one of its playlists, segments or parts
+ * counts as a viewer, and the thread detaches from the shared ingest once no
+ * request has come for hls_idle_timeout seconds. Its consumer is attached
+ * again, with the ingest's recent GOPs, by the next request.
+ *
+ * Requests are tracked per stream registry ID and only for streams whose HLS
+ * thread registered them, so names taken from URLs cannot grow the table.
+ */
+
+/**
+ * Check whether a stream's live HLS is written only while it is watched
+ * Needs the shared ingest, and leaves out streams whose segments are kept as
+ * recordings (hls_recording).
+ *
+ * @param config Stream configuration
+ * @return true if the stream's HLS output follows its viewers
+ */
+bool hls_viewers_applies(const stream_config_t *config);
+
+/**
+ * Start tracking the viewers of a stream, called by its HLS thread
+ *
+ * @param stream_name Name of the stream
+ * @return 0 on success, -1 on error
+ */
+int hls_viewers_register(const char *stream_name);
+
+/**
+ * Stop tracking the viewers of a stream
+ *
+ * @param stream_name Name of the stream
+ */
+void hls_viewers_unregister(const char *stream_name);
+
+/**
+ * Count an HLS request for a stream, waking its HLS thread if it is idle
+ * Does nothing for streams that are not on demand.
+ *
+ * @param stream_name Name of the stream
+ */
+void hls_viewers_touch(const char *stream_name);
+
+/**
+ * Check whether a stream is on demand, i.e. registered
+ *
+ * @param stream_name Name of the stream
+ * @return true if the stream's HLS output follows its viewers
+ */
+bool hls_viewers_on_demand(const char *stream_name);
+
+/**
+ * Check whether a stream had an HLS request within a time
+ *
+ * @param stream_name Name of the stream
+ * @param idle_seconds Longest time since the last request
+ * @return true if the stream is being watched
+ */
+bool hls_viewers_active(const char *stream_name, int idle_seconds);
+
+/**
+ * Wait for an HLS request for a stream
+ *
+ * @param stream_name Name of the stream
+ * @param timeout_ms Longest wait
+ * @return true if a request came within the last second or during the wait
+ */
+bool hls_viewers_wait(const char *stream_name, int timeout_ms);
+
+#endif /* HLS_VIEWERS_H */
@@ -0,0 +1,143 @@
+/**
+ * HLS Recording
+ *
+ * With [storage] hls_recording, a stream that records and serves fMP4 HLS
+ * keeps its HLS segments as the recording instead of muxing the same
+ * packets a second time into MP4 files. Each segment the HLS writer closes
+ * is hard linked into the directory of the current recording (copied when
+ * the HLS directory is on another file system), appended to the
+ * recording's playlist and indexed in the recording_segments table. A
+ * recording rolls over after the stream's segment_duration, like MP4
+ * recordings do.
+ *
+ * A recording is a directory next to the stream's MP4 recordings, named
+ * like them (recording_<time>/), holding:
+ *   index.m3u8   Playlist of the segments; the recording's file_path
+ *   init.mp4     Initialization section (EXT-X-MAP)
+ *   <n>.m4s      Segment n of the recording
+ *
+ * The initialization section followed by the segments is a fragmented MP4,
+ * which is what playback and downloads serve. FFmpeg (clip export,
+ * thumbnails) reads the recording through its playlist.
+ */
+
+#ifndef LIGHTNVR_HLS_RECORDING_H
+#define LIGHTNVR_HLS_RECORDING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <libavformat/avformat.h>
+
+#include "core/config.h"
+#include "database/db_recordings.h"
+
+#define HLS_RECORDING_PLAYLIST_NAME "index.m3u8"
+#define HLS_RECORDING_INIT_NAME "init.mp4"
+
+// Recording of one HLS writer, used only from its thread
+typedef struct hls_recording hls_recording_t;
+
+// Files of a recording in playback order, the initialization section first
+typedef struct {
+    char **paths;
+    int count;
+    int64_t start_ms;       // Offset of the first segment listed in the recording
+} hls_recording_files_t;
+
+/**
+ * Check whether a stream records through its HLS segments
+ * True for streams that record, stream fMP4 HLS and have their segments
+ * on disk, when hls_recording is enabled.
+ *
+ * @param config Stream configuration
+ * @return true if the stream records no MP4 files
+ */
+bool hls_recording_applies(const stream_config_t *config);
+
+/**
+ * Check whether a recording's file is the playlist of HLS segments
+ *
+ * @param file_path File path of the recording
+ * @return true for recordings made by hls_recording
+ */
+bool hls_recording_is_segmented(const char *file_path);
+
+/**
+ * Start recording the segments of an HLS writer
+ * The first recording starts with the next segment added.
+ *
+ * @param stream_name Name of the stream
+ * @param max_duration Seconds after which a new recording starts, 0 for the default
+ * @return Recording state, or NULL on failure
+ */
+hls_recording_t *hls_recording_create(const char *stream_name, int max_duration);
+
+/**
+ * Add a segment the HLS writer closed to the current recording
+ *
+ * @param recording Recording state, NULL is ignored
+ * @param muxer HLS muxer that wrote the segment, for the codec of the recording
+ * @param segment_path Path of the segment, next to the muxer's init.mp4
+ * @param duration Duration of the segment in seconds, 0 if unknown
+ * @param size Size of the segment in bytes
+ */
+void hls_recording_add_segment(hls_recording_t *recording, const AVFormatContext *muxer,
+                               const char *segment_path, double duration, int64_t size);
+
+/**
+ * Finish the current recording and free the state
+ * Called after the HLS muxer wrote its last segment.
+ *
+ * @param recording Recording state, may be NULL
+ */
+void hls_recording_close(hls_recording_t *recording);
+
+/**
+ * Get the files of a recording to serve it as one fragmented MP4
+ *
+ * @param id Recording ID
+ * @param file_path File path of the recording
+ * @param from_ms Leave out the segments that end before this offset
+ * @param files Receives the files; release with hls_recording_free_files()
+ * @return 0 on success, -1 if the recording has no segments to serve
+ */
+int hls_recording_get_files(uint64_t id, const char *file_path, int64_t from_ms,
+                            hls_recording_files_t *files);
+
+/**
+ * Release the files from hls_recording_get_files()
+ *
+ * @param files Files, may be empty
+ */
+void hls_recording_free_files(hls_recording_files_t *files);
+
+/**
+ * Get the path of a file of a recording by its VOD resource name
+ *
+ * @param file_path File path of the recording
+ * @param file_name HLS_RECORDING_INIT_NAME or <n>.m4s
+ * @param path Buffer receiving the path
+ * @param size Size of the buffer
+ * @return 0 on success, -1 if the name is not a file of a recording
+ */
+int hls_recording_resource_path(const char *file_path, const char *file_name, char *path, size_t size);
+
+/**
+ * Delete a recording's file; for HLS recordings, its whole directory
+ *
+ * @param file_path File path of the recording
+ * @return 0 on success, -1 with errno set like unlink()
+ */
+int hls_recording_unlink(const char *file_path);
+
+/**
+ * Finish a recording left incomplete by an interruption
+ * Its end and size are taken from the segments indexed before it.
+ *
+ * @param recording Recording, with at least id, file_path and start_time
+ * @return 0 if the recording was finished, -1 if it has no segments
+ */
+int hls_recording_finalize(const recording_metadata_t *recording);
+
+#endif /* LIGHTNVR_HLS_RECORDING_H */
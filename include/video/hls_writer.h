@@ -7,6 +7,12 @@
 #include <libavcodec/bsf.h>
 
 #include "core/config.h"
+#include "core/metrics.h"
+#include "core/pipeline_trace.h"
+#include "video/annexb_filter.h"
+#include "video/packet_pool.h"
+#include "video/hls/hls_ll_packager.h"
+#include "video/hls_recording.h"
 
 // Use a different name to avoid conflict with MAX_PATH_LENGTH in config.h
 #define HLS_MAX_PATH_LENGTH 1024
@@ -26,6 +32,7 @@ typedef struct hls_writer_t {
     char output_dir[MAX_PATH_LENGTH];
     char stream_name[MAX_STREAM_NAME];
     int segment_duration;
+    hls_segment_format_t segment_format;  // MPEG-TS, or fMP4 with an init segment
     AVFormatContext *output_ctx;
     int initialized;
     time_t last_cleanup_time;
@@ -36,8 +43,40 @@ typedef struct hls_writer_t {
     // Counter for DTS jumps to detect stream issues
     int dts_jump_count;
 
-    // Bitstream filter context for H.264 streams
-    AVBSFContext *bsf_ctx;
+    // Converts length-prefixed H.264/HEVC input to Annex B for MPEG-TS (not used for fMP4)
+    annexb_filter_t annexb_filter;
+
+    // Per-stream pool for the packets written by this writer
+    packet_pool_t *packet_pool;
+
+    // Keep segments in the segment index instead of on disk (hls_memory_store)
+    bool memory_store;
+
+    // The segment being written is kept in memory, by memory_store or because
+    // the disk is rated critical (see storage_latency.h)
+    bool segment_in_memory;
+
+    // Segment being written by the muxer, recorded in the segment index when closed
+    AVIOContext *segment_pb;
+    char segment_path[MAX_PATH_LENGTH];
+    int64_t segment_sequence;
+    int64_t segment_start_pts;   // In the output time base
+    int64_t last_pts;            // PTS of the last packet passed to the muxer
+    metric_t segment_metric;     // Time to finish a segment and add it to the index
+
+    // Pipeline latency of the first frame of each segment (see pipeline_trace.h)
+    pipeline_trace_t packet_trace;   // Set by the caller before hls_writer_write_packet()
+    pipeline_trace_t segment_trace;  // First frame of the segment being written
+    pipeline_trace_t closed_trace;   // First frame of the segment last closed, until a playlist lists it
+    AVIOContext *playlist_pb;        // Playlist being written by the muxer
+    metric_t segment_close_metric;
+    metric_t playlist_metric;
+
+    // Low-Latency HLS packager fed with the same packets (hls_low_latency)
+    hls_ll_packager_t *ll_packager;
+
+    // Recording made of the segments on disk (hls_recording), NULL if the stream records MP4
+    hls_recording_t *recording;
 
     // Thread context for standalone operation
     void *thread_ctx;
@@ -48,8 +87,14 @@ typedef struct hls_writer_t {
 
 /**
  * Create new HLS writer
+ *
+ * @param output_dir Directory of the playlist and segments
+ * @param stream_name Name of the stream
+ * @param segment_duration Target segment duration in seconds
+ * @param segment_format MPEG-TS segments, or CMAF fMP4 segments with init.mp4
  */
-hls_writer_t *hls_writer_create(const char *output_dir, const char *stream_name, int segment_duration);
+hls_writer_t *hls_writer_create(const char *output_dir, const char *stream_name, int segment_duration,
+                                hls_segment_format_t segment_format);
 
 /**
  * Initialize HLS writer with stream information
@@ -0,0 +1,68 @@
+/**
+ * Hardware-accelerated Decoding
+ *
+ * Small abstraction over the FFmpeg hardware decoding paths, selected with
+ * the [hardware] hw_accel_enabled / hw_accel_device settings:
+ * - hwaccel devices (VAAPI, CUDA/NVDEC, QSV) attached to the regular decoder
+ * - dedicated wrapper decoders (RKMPP, V4L2 M2M) such as h264_rkmpp
+ *
+ * hw_accel_device is either empty/"auto" to probe the available backends, or
+ * a backend name optionally followed by a device, e.g. "vaapi:/dev/dri/renderD128".
+ * When no backend can be used, decoding silently falls back to software.
+ */
+
+#ifndef LIGHTNVR_HW_DECODE_H
+#define LIGHTNVR_HW_DECODE_H
+
+#include <stdbool.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/frame.h>
+
+/**
+ * Find the decoder to use for a codec
+ * Returns the wrapper decoder of the selected backend when it has one for the
+ * codec (e.g. hevc_rkmpp), otherwise the default software decoder.
+ *
+ * @param codec_id Codec to decode
+ * @return Decoder or NULL if the codec is not supported at all
+ */
+const AVCodec *hw_decode_find_decoder(enum AVCodecID codec_id);
+
+/**
+ * Attach the selected hwaccel device to a decoder context
+ * Must be called after avcodec_parameters_to_context and before avcodec_open2.
+ *
+ * @param codec_ctx Decoder context
+ * @return 0 if hardware decoding was set up, 1 if the context decodes in software
+ */
+int hw_decode_setup(AVCodecContext *codec_ctx);
+
+/**
+ * Get a frame whose pixels are in system memory
+ *
+ * @param frame Decoded frame
+ * @param sw_frame Frame receiving the downloaded pixels for hardware frames
+ * @return frame itself for software frames, sw_frame after a download, or NULL on failure
+ */
+const AVFrame *hw_decode_get_sw_frame(const AVFrame *frame, AVFrame *sw_frame);
+
+/**
+ * Get the name of the selected backend
+ *
+ * @return Backend name, or "software" when hardware decoding is not used
+ */
+const char *hw_decode_backend_name(void);
+
+/**
+ * Get a reference to the shared hwaccel device, for hardware encoders
+ *
+ * @return New reference, or NULL for wrapper backends and software decoding
+ */
+AVBufferRef *hw_decode_device_ref(void);
+
+/**
+ * Release the shared hardware device
+ */
+void hw_decode_cleanup(void);
+
+#endif /* LIGHTNVR_HW_DECODE_H */
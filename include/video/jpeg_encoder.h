@@ -0,0 +1,78 @@
+/**
+ * In-Memory JPEG Encoder
+ *
+ * Encodes raw grayscale, RGB or RGBA frames, or decoded video frames, to
+ * JPEG in memory with FFmpeg's MJPEG encoder. An encoder keeps its codec and
+ * scaler between frames of the same size, so encoding a stream of frames
+ * only pays for the encoding.
+ */
+
+#ifndef LIGHTNVR_JPEG_ENCODER_H
+#define LIGHTNVR_JPEG_ENCODER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <libavutil/frame.h>
+
+typedef struct jpeg_encoder jpeg_encoder_t;
+
+/**
+ * Create an encoder
+ *
+ * @return New encoder, or NULL on allocation failure
+ */
+jpeg_encoder_t *jpeg_encoder_create(void);
+
+/**
+ * Destroy an encoder and the last image it produced
+ *
+ * @param encoder Encoder, may be NULL
+ */
+void jpeg_encoder_destroy(jpeg_encoder_t *encoder);
+
+/**
+ * Encoder of the calling thread, created on first use and destroyed when
+ * the thread exits
+ * Lets code running on many threads encode in parallel without sharing an
+ * encoder.
+ *
+ * @return The thread's encoder, or NULL on allocation failure
+ */
+jpeg_encoder_t *jpeg_encoder_for_thread(void);
+
+/**
+ * Encode a frame to JPEG
+ * The image stays valid until the next call on the encoder.
+ *
+ * @param encoder Encoder
+ * @param data Packed pixels, width * channels bytes per row
+ * @param width Frame width
+ * @param height Frame height
+ * @param channels 1 (gray), 3 (RGB) or 4 (RGBA)
+ * @param quality JPEG quality from 1 to 100
+ * @param jpeg Set to the encoded image
+ * @param jpeg_size Set to the size of the encoded image
+ * @return 0 on success, -1 on failure
+ */
+int jpeg_encoder_encode(jpeg_encoder_t *encoder, const uint8_t *data, int width, int height,
+                        int channels, int quality, const uint8_t **jpeg, size_t *jpeg_size);
+
+/**
+ * Encode a decoded video frame to JPEG, scaling it down on the way
+ * The frame is converted straight from its own pixel format, so decoded
+ * YUV frames never go through RGB. The image stays valid until the next
+ * call on the encoder.
+ *
+ * @param encoder Encoder
+ * @param frame Frame in system memory
+ * @param width Image width, 0 or more than the frame's for the frame's own;
+ *              the height follows the aspect ratio
+ * @param quality JPEG quality from 1 to 100
+ * @param jpeg Set to the encoded image
+ * @param jpeg_size Set to the size of the encoded image
+ * @return 0 on success, -1 on failure
+ */
+int jpeg_encoder_encode_frame(jpeg_encoder_t *encoder, const AVFrame *frame, int width, int quality,
+                              const uint8_t **jpeg, size_t *jpeg_size);
+
+#endif /* LIGHTNVR_JPEG_ENCODER_H */
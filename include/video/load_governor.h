@@ -0,0 +1,102 @@
+/**
+ * Load Governor
+ *
+ * Samples CPU and memory usage every few seconds and, when the box stays
+ * overloaded, sheds detection work one step at a time so recording keeps
+ * its share of the machine:
+ *
+ *   1. detection intervals are doubled
+ *   2. detection decodes key frames only
+ *   3. detection pauses on low-priority streams
+ *
+ * Recording, HLS and live view are never throttled. Once the load has been
+ * low for a while the steps are undone in reverse order.
+ */
+
+#ifndef LIGHTNVR_LOAD_GOVERNOR_H
+#define LIGHTNVR_LOAD_GOVERNOR_H
+
+#include <stdbool.h>
+#include <time.h>
+
+// How much detection work is shed
+typedef enum {
+    LOAD_SHED_NONE = 0,
+    LOAD_SHED_REDUCE_RATE,          // Detection intervals doubled
+    LOAD_SHED_KEY_FRAMES,           // Plus key frames only
+    LOAD_SHED_PAUSE_LOW_PRIORITY    // Plus no detection on low-priority streams
+} load_shed_level_t;
+
+// Change of the shedding level
+typedef struct {
+    time_t time;
+    load_shed_level_t level;        // New level
+    load_shed_level_t previous;     // Level before the change
+    double cpu_usage;               // Percent, at the change
+    double memory_usage;            // Percent of system memory, at the change
+} load_shed_event_t;
+
+// Current load and shedding level
+typedef struct {
+    bool enabled;
+    load_shed_level_t level;
+    double cpu_usage;               // Percent over the last sample period
+    double memory_usage;            // Percent of system memory in use
+    unsigned long long process_memory; // Resident memory of LightNVR in bytes
+} load_governor_status_t;
+
+// Shedding events kept for the API
+#define LOAD_SHED_MAX_EVENTS 32
+
+/**
+ * Start sampling the load, if [load_shedding] is enabled
+ *
+ * @return 0 on success (or when disabled), -1 on error
+ */
+int load_governor_init(void);
+
+/**
+ * Stop sampling the load and undo all shedding
+ */
+void load_governor_shutdown(void);
+
+/**
+ * Current shedding level
+ *
+ * @return Level, LOAD_SHED_NONE when the governor is not running
+ */
+load_shed_level_t load_governor_level(void);
+
+/**
+ * Whether detection of a stream is paused by the governor
+ *
+ * @param priority Stream priority (1-10)
+ * @return true if the stream should not run detection now
+ */
+bool load_governor_detection_paused(int priority);
+
+/**
+ * Get the current load and shedding level
+ *
+ * @param status Receives the status
+ */
+void load_governor_get_status(load_governor_status_t *status);
+
+/**
+ * Get the most recent shedding events, newest first
+ *
+ * @param events Receives the events
+ * @param max_events Capacity of events
+ * @return Number of events
+ */
+int load_governor_get_events(load_shed_event_t *events, int max_events);
+
+/**
+ * Name of a shedding level, for logs and the API
+ *
+ * @param level Level
+ * @return Static string
+ */
+const char *load_shed_level_name(load_shed_level_t level);
+
+#endif /* LIGHTNVR_LOAD_GOVERNOR_H */
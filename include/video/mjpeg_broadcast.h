@@ -0,0 +1,67 @@
+/**
+ * Live MJPEG Broadcast
+ *
+ * Serves streams as Motion JPEG for clients that can show nothing else,
+ * such as old browsers, hardware decoders and signage players. A service
+ * thread takes the newest frame of every stream that has viewers from the
+ * snapshot cache, at mjpeg_fps and mjpeg_width, and publishes it as JPEG.
+ * Each frame is encoded once and the same image is sent to every viewer of
+ * the stream, so a wall of displays costs one encode per camera and frame
+ * instead of a decode and encode per display.
+ *
+ * Frames come from the stream's live detection decoder; while the load
+ * governor has it decoding key frames only, there is at most one frame
+ * per key frame.
+ */
+
+#ifndef LIGHTNVR_MJPEG_BROADCAST_H
+#define LIGHTNVR_MJPEG_BROADCAST_H
+
+#include <stdint.h>
+
+#include <libavutil/buffer.h>
+
+// JPEG quality of the broadcast frames
+#define MJPEG_BROADCAST_QUALITY 70
+
+/**
+ * Start the broadcast thread, unless mjpeg_max_clients is 0
+ *
+ * @return 0 on success (or when disabled), -1 on error
+ */
+int mjpeg_broadcast_init(void);
+
+/**
+ * Stop the broadcast thread and drop the published frames
+ */
+void mjpeg_broadcast_shutdown(void);
+
+/**
+ * Add a viewer to the broadcast of a stream
+ *
+ * @param stream_name Name of the stream
+ * @return Channel to get frames from, or -1 if the broadcast is disabled
+ *         or has mjpeg_max_clients viewers
+ */
+int mjpeg_broadcast_join(const char *stream_name);
+
+/**
+ * Remove a viewer added by mjpeg_broadcast_join()
+ *
+ * @param channel Channel of the viewer
+ */
+void mjpeg_broadcast_leave(int channel);
+
+/**
+ * Get the newest frame of a channel if it is not the one a viewer has
+ * Cheap when there is no new frame, so it can be called on every poll.
+ *
+ * @param channel Channel of the viewer
+ * @param seq Frame the viewer has, 0 for none
+ * @param jpeg Set to a reference to the new frame, to release with
+ *             av_buffer_unref(), or to NULL if there is none
+ * @return Sequence number of the frame set in jpeg, or seq if there is none
+ */
+uint64_t mjpeg_broadcast_frame(int channel, uint64_t seq, AVBufferRef **jpeg);
+
+#endif /* LIGHTNVR_MJPEG_BROADCAST_H */
@@ -2,10 +2,16 @@
 #define MOTION_DETECTION_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <time.h>
 #include "../video/detection_result.h"
 
+// Largest grid a motion mask may divide the frame into
+#define MOTION_MASK_MAX_GRID 32
+
+struct AVMotionVector;
+
 /**
  * Initialize the motion detection system
  * 
@@ -46,6 +52,48 @@ int detect_motion(const char *stream_name, const unsigned char *frame_data,
                  int width, int height, int channels, time_t frame_time,
                  detection_result_t *result);
 
+/**
+ * Process a luma plane for motion detection
+ * Takes the Y plane of a decoded YUV frame (AVFrame data[0] and linesize[0])
+ * directly, so no RGB conversion is needed; the plane is downscaled while it
+ * is read.
+ * With grid detection the box of a motion detection covers the grid cells
+ * that moved, otherwise the whole frame.
+ *
+ * @param stream_name The name of the stream
+ * @param luma Luma plane
+ * @param linesize Bytes between rows of the plane
+ * @param width Frame width
+ * @param height Frame height
+ * @param frame_time Timestamp of the frame
+ * @param result Pointer to detection result structure to fill
+ * @return 0 on success, non-zero on failure
+ */
+int detect_motion_luma(const char *stream_name, const uint8_t *luma, int linesize,
+                       int width, int height, time_t frame_time, detection_result_t *result);
+
+/**
+ * Process the motion vectors a decoder exported for a frame
+ * Motion is taken from the compressed domain instead of pixels: a grid cell
+ * moves when enough of its area is covered by blocks whose vector is at
+ * least 2 pixels long, or by intra blocks, which carry no
+ * vector and are the area left uncovered. There is no grayscale conversion,
+ * blur or background model, so this costs next to nothing beyond decoding.
+ * Only predicted frames can be passed; a frame predicted from nothing would
+ * count as all intra. Masked cells and the cooldown apply as with pixels.
+ *
+ * @param stream_name The name of the stream
+ * @param vectors Motion vectors of the frame (AV_FRAME_DATA_MOTION_VECTORS)
+ * @param count Number of vectors
+ * @param width Frame width
+ * @param height Frame height
+ * @param frame_time Timestamp of the frame
+ * @param result Pointer to detection result structure to fill
+ * @return 0 on success, non-zero on failure
+ */
+int detect_motion_vectors(const char *stream_name, const struct AVMotionVector *vectors, int count,
+                          int width, int height, time_t frame_time, detection_result_t *result);
+
 /**
  * Configure advanced motion detection parameters
  * 
@@ -71,6 +119,46 @@ int configure_advanced_motion_detection(const char *stream_name, int blur_radius
  */
 int configure_motion_detection_optimizations(const char *stream_name, bool downscale_enabled, int downscale_factor);
 
+/**
+ * Parse the text form of a stream's motion mask
+ * The mask divides the frame into a grid of grid_size x grid_size cells and
+ * marks the cells motion detection ignores. Its text is the grid size, a
+ * colon, and one group of grid_size / 4 (rounded up) hex digits per row of
+ * cells from the top, the high bit of a row's first digit being its left
+ * cell. An 8x8 mask ignoring the top row and the left column:
+ *
+ *   "8:ff80808080808080"
+ *
+ * @param text Mask text, empty or NULL for none
+ * @param rows Receives MOTION_MASK_MAX_GRID rows, bit x of row y set for a masked cell
+ * @return Grid size (0 without a mask), -1 if the text is invalid
+ */
+int parse_motion_mask(const char *text, uint32_t *rows);
+
+/**
+ * Write a motion mask in its text form
+ * A mask without masked cells is written as the empty string.
+ *
+ * @param grid_size Grid size (2-MOTION_MASK_MAX_GRID)
+ * @param rows Rows as filled in by parse_motion_mask()
+ * @param text Receives the text
+ * @param size Size of text (MAX_MOTION_MASK_TEXT holds any mask)
+ * @return 0 on success, -1 if the text does not fit
+ */
+int format_motion_mask(int grid_size, const uint32_t *rows, char *text, size_t size);
+
+/**
+ * Set the cells of a stream's frame that motion detection ignores
+ * Grid detection then runs on the mask's grid, and the difference, blur and
+ * background update passes skip the masked cells, so they neither trigger
+ * detections nor cost processing time.
+ *
+ * @param stream_name The name of the stream
+ * @param mask_text Mask in the text form of parse_motion_mask(), empty or NULL for none
+ * @return 0 on success, non-zero on failure
+ */
+int configure_motion_mask(const char *stream_name, const char *mask_text);
+
 /**
  * Enable or disable motion detection for a stream
  * 
@@ -0,0 +1,124 @@
+/**
+ * Motion Detection Pixel Kernels
+ *
+ * Grayscale conversion, block downscaling, the two box blur passes, the
+ * thresholded frame difference and the background update used by motion
+ * detection, with NEON, SSE2/SSSE3 and AVX2 implementations picked
+ * once at runtime from the CPU features. Every vector implementation gives
+ * exactly the same output as the scalar reference, so detection results do
+ * not depend on the machine.
+ */
+
+#ifndef LIGHTNVR_MOTION_KERNELS_H
+#define LIGHTNVR_MOTION_KERNELS_H
+
+#include <stdint.h>
+
+/**
+ * Name of the instruction set the kernels use on this CPU
+ *
+ * @return "avx2", "ssse3", "sse2", "neon" or "scalar"
+ */
+const char *motion_kernels_isa(void);
+
+/**
+ * List the instruction sets the kernels are compiled for and the CPU supports
+ *
+ * @param isas Receives the names, widest (the default) first
+ * @param max Size of isas
+ * @return Number of names stored
+ */
+int motion_kernels_variants(const char **isas, int max);
+
+/**
+ * Switch the kernels to an instruction set, for benchmarks and tests
+ * Not thread safe: nothing may run the kernels meanwhile.
+ *
+ * @param isa Name from motion_kernels_variants(), or NULL for the default
+ * @return 0 on success, -1 if the instruction set is not available
+ */
+int motion_kernels_use(const char *isa);
+
+/**
+ * Convert packed RGB24 to 8-bit luma with 8-bit fixed-point BT.601 weights
+ *
+ * @param rgb Source pixels, 3 bytes each
+ * @param gray Destination, one byte per pixel
+ * @param pixels Number of pixels
+ */
+void motion_rgb_to_gray(const uint8_t *rgb, uint8_t *gray, int pixels);
+
+/**
+ * Downscale by averaging factor x factor blocks
+ * Blocks reaching past the source are averaged over the pixels they cover.
+ *
+ * @param src Source image
+ * @param stride Bytes between source rows (at least width)
+ * @param width Source width
+ * @param height Source height
+ * @param factor Block size
+ * @param dst Destination image of out_width x out_height
+ * @param out_width Destination width
+ * @param out_height Destination height
+ */
+void motion_downscale_gray(const uint8_t *src, int stride, int width, int height, int factor,
+                           uint8_t *dst, int out_width, int out_height);
+
+/**
+ * Horizontal box blur pass
+ * Each pixel becomes the truncated mean of the pixels within radius on its
+ * row. Running sums make the cost per pixel independent of the radius.
+ *
+ * @param src Source image
+ * @param dst Destination image, not overlapping src
+ * @param sums Scratch space for width + 1 sums
+ * @param width Width
+ * @param height Height
+ * @param radius Blur radius (greater than 0)
+ */
+void motion_box_blur_rows(const uint8_t *src, uint8_t *dst, uint16_t *sums, int width, int height, int radius);
+
+/**
+ * Vertical box blur pass
+ * Each pixel becomes the truncated mean of the pixels within radius in its
+ * column. Running sums make the cost per pixel independent of the radius.
+ *
+ * @param src Source image
+ * @param dst Destination image, not overlapping src
+ * @param sums Scratch space for width + 1 sums
+ * @param width Width
+ * @param height Height
+ * @param radius Blur radius (greater than 0)
+ */
+void motion_box_blur_cols(const uint8_t *src, uint8_t *dst, uint16_t *sums, int width, int height, int radius);
+
+/**
+ * Thresholded frame difference of a row span
+ * For every step-th pixel from the first, the larger of its differences to
+ * the previous frame and to the background is added to sum, and counted in
+ * changed, when it exceeds threshold.
+ *
+ * @param cur Current frame pixels
+ * @param prev Previous frame pixels
+ * @param bg Background model pixels
+ * @param count Number of pixels in the span
+ * @param step Sampling step, 1 or 2
+ * @param threshold Differences must be greater than this to count
+ * @param sum Accumulates the differences above threshold
+ * @param changed Accumulates the number of pixels above threshold
+ */
+void motion_diff_sum(const uint8_t *cur, const uint8_t *prev, const uint8_t *bg, int count, int step,
+                     int threshold, uint32_t *sum, uint32_t *changed);
+
+/**
+ * Exponential background update in 8-bit fixed point
+ * background = ((256 - alpha) * background + alpha * current) >> 8
+ *
+ * @param background Background model, updated in place
+ * @param current Current frame
+ * @param pixels Number of pixels
+ * @param alpha Learning rate in 1/256 units (0-256)
+ */
+void motion_blend_background(uint8_t *background, const uint8_t *current, int pixels, int alpha);
+
+#endif /* LIGHTNVR_MOTION_KERNELS_H */
@@ -0,0 +1,34 @@
+/**
+ * MP4 Recording Recovery
+ *
+ * Finalizes recordings that were interrupted by a crash or power loss. A
+ * fragmented MP4 recording (mp4_fragmented) is made of self-contained
+ * moof/mdat pairs, so recovering it only takes walking its top-level box
+ * headers and truncating after the last complete fragment; no demuxing or
+ * probing of the recordings directory is needed.
+ */
+
+#ifndef LIGHTNVR_MP4_RECOVERY_H
+#define LIGHTNVR_MP4_RECOVERY_H
+
+#include <stdint.h>
+
+/**
+ * Truncate a fragmented MP4 file after its last complete fragment
+ *
+ * @param path Path of the file
+ * @param size Receives the size of the file after recovery
+ * @return 0 if the file is playable, -1 if it has no complete fragment or
+ *         is not a fragmented MP4
+ */
+int mp4_recovery_finalize_file(const char *path, uint64_t *size);
+
+/**
+ * Finalize the recordings left incomplete in the database by the last run
+ * Must be called at startup, before any recording thread is started.
+ *
+ * @return Number of recordings finalized
+ */
+int mp4_recovery_finalize_incomplete(void);
+
+#endif /* LIGHTNVR_MP4_RECOVERY_H */
@@ -13,7 +13,9 @@
 #define MP4_SEGMENT_RECORDER_H
 
 #include <stdbool.h>
+#include <time.h>
 #include <libavformat/avformat.h>
+#include "video/stream_ingest.h"
 
 /**
  * Structure to track segment information
@@ -22,6 +24,7 @@ typedef struct {
     int segment_index;
     bool has_audio;
     bool last_frame_was_key;  // Flag to indicate if the last frame of previous segment was a key frame
+    int64_t last_segment_size; // Size of the previous segment, used to preallocate the next one
 } segment_info_t;
 
 /**
@@ -52,6 +55,79 @@ typedef struct {
  */
 int record_segment(const char *rtsp_url, const char *output_file, int duration, int has_audio);
 
+/**
+ * Input kept open across segments
+ *
+ * The writer thread owns one of these per stream. The RTSP connection (or the
+ * shared ingest consumer) stays open between segments and only the output
+ * muxer is rotated. The key frame that ends a segment is carried over to start
+ * the next one, so no GOP is lost at the boundary.
+ */
+typedef struct {
+    char url[MAX_PATH_LENGTH];           // Input URL for a direct connection
+    AVFormatContext *input_ctx;          // Direct input, NULL until opened or after an error
+    stream_ingest_consumer_t *consumer;  // Shared ingest consumer, or NULL for a direct connection
+    AVPacket *carry_pkt;                 // Key frame that ended the previous segment
+    segment_info_t info;                 // Continuity info for this stream's segments
+    char stream_name[MAX_STREAM_NAME];   // Stream recorded, for its standby output (see mp4_standby.h); may be empty
+} mp4_segment_input_t;
+
+/**
+ * Boundaries of a recorded segment
+ */
+typedef struct {
+    time_t start_time;        // Wall-clock time of the first key frame in the segment
+    time_t end_time;          // Wall-clock time the segment was closed
+    int64_t duration_ms;      // Media duration of the video in milliseconds
+    int video_packets;        // Video packets written
+    int audio_packets;        // Audio packets written
+    bool ended_on_keyframe;   // The next segment starts with the carried-over key frame
+} mp4_segment_boundary_t;
+
+/**
+ * Initialize a persistent segment input
+ *
+ * @param input Input to initialize
+ * @param rtsp_url URL to open for a direct connection (may be NULL with a consumer)
+ * @param consumer Shared ingest consumer to read from, or NULL for a direct connection
+ * @return 0 on success, -1 on error
+ */
+int mp4_segment_input_init(mp4_segment_input_t *input, const char *rtsp_url,
+                           stream_ingest_consumer_t *consumer);
+
+/**
+ * Set the muxer options of an MP4 recording
+ * Shared with the standby outputs, whose header is written before they are used.
+ *
+ * @param opts Dictionary to add the options to
+ */
+void mp4_segment_output_options(AVDictionary **opts);
+
+/**
+ * Record the next segment from a persistent input
+ *
+ * Behaves like record_segment, but the input is kept open when the segment
+ * ends and the output is rotated on the next key frame. If the input fails it
+ * is closed and reopened on the next call.
+ *
+ * @param input Persistent input
+ * @param output_file The path to the output MP4 file
+ * @param duration The duration to record in seconds
+ * @param has_audio Flag indicating whether to include audio in the recording
+ * @param boundary Filled with the segment boundaries on success (may be NULL)
+ * @return 0 on success, negative value on error
+ */
+int record_segment_continuous(mp4_segment_input_t *input, const char *output_file,
+                              int duration, int has_audio, mp4_segment_boundary_t *boundary);
+
+/**
+ * Close a persistent segment input
+ * The shared ingest consumer, if any, is not detached.
+ *
+ * @param input Persistent input
+ */
+void mp4_segment_input_close(mp4_segment_input_t *input);
+
 /**
  * Initialize the MP4 segment recorder
  * This function should be called during program startup
@@ -0,0 +1,79 @@
+/**
+ * MP4 Standby Outputs
+ *
+ * A detection-triggered recording used to spend its first moments on work
+ * unrelated to the event: creating directories through the shell, setting
+ * up the muxer, creating and preallocating the file and writing its header,
+ * all while the moment that triggered it was going by.
+ *
+ * For every stream recording on detection that is not recording, a service
+ * thread keeps that work done ahead of time: an MP4 output with the
+ * stream's codec parameters, its header written to a hidden file in the
+ * stream's recording directory, preallocated for a segment at the ingest's
+ * current bitrate. When a recording starts, the recorder takes the standby
+ * output, renames the file to the recording's name and writes the pre-roll
+ * and live packets into it straight away. If the stream's codec parameters
+ * changed in the meantime the standby output is discarded and the recorder
+ * sets up its own as before.
+ */
+
+#ifndef LIGHTNVR_MP4_STANDBY_H
+#define LIGHTNVR_MP4_STANDBY_H
+
+#include <stdbool.h>
+#include <libavformat/avformat.h>
+
+/**
+ * Start keeping standby outputs, if mp4_standby is enabled
+ *
+ * @return 0 on success (or when disabled), -1 on error
+ */
+int mp4_standby_init(void);
+
+/**
+ * Stop keeping standby outputs and remove their files
+ */
+void mp4_standby_shutdown(void);
+
+/**
+ * Check whether a stream has a standby output
+ * Its recording directory then exists already.
+ *
+ * @param stream_name Name of the stream
+ * @return true if a standby output is ready
+ */
+bool mp4_standby_ready(const char *stream_name);
+
+/**
+ * Note that the recording of a stream was started, for timing its first write
+ *
+ * @param stream_name Name of the stream
+ */
+void mp4_standby_triggered(const char *stream_name);
+
+/**
+ * Take the standby output of a stream for a recording
+ *
+ * The output is only handed out if it matches the input's codec
+ * parameters; otherwise it is discarded. The header has been written, so
+ * the caller goes on with the packets.
+ *
+ * @param stream_name Name of the stream
+ * @param output_file Path the file is renamed to
+ * @param input_ctx Input the recording reads from
+ * @param video_idx Index of the video stream in input_ctx
+ * @param audio_idx Index of the audio stream to record, -1 for none
+ * @return Output context with its file open, or NULL if there is no usable standby
+ */
+AVFormatContext *mp4_standby_take(const char *stream_name, const char *output_file,
+                                  const AVFormatContext *input_ctx, int video_idx, int audio_idx);
+
+/**
+ * Note that a recording wrote its header, with or without a standby output
+ * Records the time since mp4_standby_triggered() for the stream.
+ *
+ * @param stream_name Name of the stream
+ */
+void mp4_standby_output_ready(const char *stream_name);
+
+#endif /* LIGHTNVR_MP4_STANDBY_H */
@@ -6,10 +6,25 @@
 #define MP4_WRITER_H
 
 #include <stddef.h>
+#include <time.h>
 #include <libavformat/avformat.h>
 #include <pthread.h>
 #include "core/config.h"  // For MAX_PATH_LENGTH and MAX_STREAM_NAME
+#include "core/metrics.h"
 #include "video/mp4_writer_thread.h"
+#include "video/packet_pool.h"
+
+/**
+ * Called after a segment file has been closed and recording moved on to the next file
+ *
+ * @param writer The MP4 writer instance
+ * @param completed_path Path of the segment that was just completed
+ * @param start_time Wall-clock time of the first key frame in the segment
+ * @param end_time Wall-clock time the segment was closed
+ * @param user_data User data passed to mp4_writer_set_segment_callback
+ */
+typedef void (*mp4_writer_segment_callback_t)(mp4_writer_t *writer, const char *completed_path,
+                                              time_t start_time, time_t end_time, void *user_data);
 
 /**
  * MP4 writer structure
@@ -50,10 +65,20 @@ struct mp4_writer {
     int waiting_for_keyframe; // Flag indicating if we're waiting for a keyframe to rotate
     int is_rotating;          // Flag indicating if rotation is in progress
     char output_dir[MAX_PATH_LENGTH]; // Directory where MP4 files are stored
+    int segment_count;        // Segments completed since the writer was created
+    time_t segment_start_time;// Start of the last completed segment
+    time_t segment_end_time;  // End of the last completed segment
+    mp4_writer_segment_callback_t segment_callback; // Notified on every segment boundary
+    void *segment_callback_data;
 
     // RTSP thread context
     mp4_writer_thread_t *thread_ctx;  // Changed from void* to proper type
 
+    // Per-stream pool for the packets written by this writer
+    packet_pool_t *packet_pool;
+
+    metric_t write_metric;    // Time to hand a packet to the muxer
+
     // Shutdown coordination
     int shutdown_component_id; // ID assigned by the shutdown coordinator
 };
@@ -104,6 +129,17 @@ void mp4_writer_close(mp4_writer_t *writer);
  */
 void mp4_writer_set_segment_duration(mp4_writer_t *writer, int segment_duration);
 
+/**
+ * Register a callback for segment boundaries
+ * The callback runs on the recording thread and must not block.
+ *
+ * @param writer The MP4 writer instance
+ * @param callback Callback to invoke, or NULL to remove it
+ * @param user_data User data passed to the callback
+ */
+void mp4_writer_set_segment_callback(mp4_writer_t *writer, mp4_writer_segment_callback_t callback,
+                                     void *user_data);
+
 // Rotation is now handled entirely by the writer thread in mp4_writer_rtsp.c
 
 /**
@@ -18,16 +18,6 @@
  */
 int mp4_writer_initialize(mp4_writer_t *writer, const AVPacket *pkt, const AVStream *input_stream);
 
-/**
- * Apply h264_mp4toannexb bitstream filter to convert H.264 stream from MP4 format to Annex B format
- * This is needed for some RTSP cameras that send H.264 in MP4 format instead of Annex B format
- * 
- * @param packet The packet to convert
- * @param codec_id The codec ID of the stream
- * @return 0 on success, negative on error
- */
-int apply_h264_annexb_filter(AVPacket *packet, enum AVCodecID codec_id);
-
 /**
  * Write a packet to the MP4 file
  * This function handles both video and audio packets
@@ -39,4 +29,12 @@ int apply_h264_annexb_filter(AVPacket *packet, enum AVCodecID codec_id);
  */
 int mp4_writer_write_packet(mp4_writer_t *writer, const AVPacket *in_pkt, const AVStream *input_stream);
 
+/**
+ * Announce a recording whose file is final on the event bus, e.g. for upload
+ *
+ * @param stream_name Stream of the recording
+ * @param recording_id ID of the recording
+ */
+void mp4_writer_publish_finished(const char *stream_name, uint64_t recording_id);
+
 #endif /* MP4_WRITER_INTERNAL_H */
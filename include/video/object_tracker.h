@@ -0,0 +1,51 @@
+/**
+ * Object Tracker
+ *
+ * Follows the objects a stream's detector reports from one detection to the
+ * next, matching boxes of the same label by overlap (IoU) and, for small
+ * fast objects whose boxes no longer overlap, by centroid distance. Every
+ * object gets a track ID; only the start of a track, significant moves and
+ * the end of a track are reported, so an object that sits in view for hours
+ * produces a couple of rows instead of one per sampled frame.
+ */
+
+#ifndef LIGHTNVR_OBJECT_TRACKER_H
+#define LIGHTNVR_OBJECT_TRACKER_H
+
+#include <time.h>
+
+#include "video/detection_result.h"
+
+// Tracks followed per stream
+#define MAX_TRACKS 32
+
+// What the detections of one frame did to a stream's tracks
+typedef struct {
+    detection_result_t changes;                // Tracks started or moved, to store at the frame time
+    int new_tracks;                            // How many of the changes are track starts
+    detection_result_t ended;                  // Tracks that were lost, at their last position
+    time_t ended_at[MAX_DETECTIONS];           // When each ended track was last seen
+} track_update_t;
+
+/**
+ * Match a frame's detections against the stream's tracks
+ * Each detection gets the ID of its track in track_id. Tracks not seen for
+ * a while are ended.
+ *
+ * @param stream_name Stream name
+ * @param detections Detections of the frame, track_id filled in
+ * @param frame_time Time of the frame
+ * @param update Receives the track starts, moves and ends
+ * @return 0 on success, -1 on failure
+ */
+int object_tracker_update(const char *stream_name, detection_result_t *detections,
+                          time_t frame_time, track_update_t *update);
+
+/**
+ * Forget the tracks of a stream
+ *
+ * @param stream_name Stream name
+ */
+void object_tracker_reset(const char *stream_name);
+
+#endif /* LIGHTNVR_OBJECT_TRACKER_H */
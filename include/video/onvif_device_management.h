@@ -4,8 +4,19 @@
 #include "video/onvif_discovery.h"
 #include <stddef.h>
 
+// Cached device capabilities older than this are refreshed in the background
+#define ONVIF_CACHE_TTL (24 * 60 * 60)
+
+// Profiles read and cached per device
+#define MAX_ONVIF_CACHED_PROFILES 16
+
+// Background cache refreshes running at the same time
+#define MAX_ONVIF_CACHE_REFRESHES 4
+
 /**
  * Get ONVIF device profiles
+ * Served from the capability cache when the device is in it, see
+ * db_onvif_cache.h; otherwise the device is queried and cached.
  * 
  * @param device_url Device service URL
  * @param username Username for authentication (can be NULL)
@@ -20,6 +31,7 @@ int get_onvif_device_profiles(const char *device_url, const char *username,
 
 /**
  * Get ONVIF stream URL for a specific profile
+ * Served from the capability cache like get_onvif_device_profiles().
  * 
  * @param device_url Device service URL
  * @param username Username for authentication (can be NULL)
@@ -21,4 +21,14 @@ int send_discovery_probe(const char *ip_addr);
  */
 int send_all_discovery_probes(int sock, const char *ip_addr, struct sockaddr_in *dest_addr);
 
+/**
+ * Send discovery probes using all message templates without pausing between them
+ * Meant for non-blocking sockets that send to many addresses in turn.
+ * 
+ * @param sock Socket to use for sending
+ * @param dest_addr Destination address structure
+ * @return Number of probes sent
+ */
+int send_discovery_probe_burst(int sock, const struct sockaddr_in *dest_addr);
+
 #endif /* ONVIF_DISCOVERY_PROBE_H */
@@ -0,0 +1,47 @@
+#ifndef ONVIF_DISCOVERY_SWEEP_H
+#define ONVIF_DISCOVERY_SWEEP_H
+
+#include <stdint.h>
+#include "video/onvif_discovery.h"
+
+// Port checks in flight at the same time
+#define ONVIF_SWEEP_MAX_IN_FLIGHT 256
+
+// Port checks started per second at most
+#define ONVIF_SWEEP_RATE 1000
+
+// Time a port check may take before the port counts as closed
+#define ONVIF_SWEEP_CONNECT_TIMEOUT_MS 1000
+
+// Time left for WS-Discovery answers after the last probe went out
+#define ONVIF_SWEEP_RESPONSE_WAIT_MS 2000
+
+// Longest a whole sweep may take
+#define ONVIF_SWEEP_TIMEOUT_MS 30000
+
+/**
+ * Sweep a range of addresses for ONVIF devices
+ *
+ * Everything runs on one epoll set: non-blocking TCP connects to ports
+ * 3702 and 80 of every address, at most ONVIF_SWEEP_MAX_IN_FLIGHT at a
+ * time and ONVIF_SWEEP_RATE per second, and one UDP socket. That socket
+ * sends WS-Discovery probes to the broadcast and multicast addresses at
+ * the start and to each host as soon as one of its ports answers, and
+ * receives the ProbeMatch replies. A /24 takes about one connect timeout
+ * plus the response wait, whatever the number of hosts.
+ *
+ * @param first_ip First address to check, in host byte order
+ * @param last_ip Last address to check, in host byte order
+ * @param broadcast Broadcast address of the network, in host byte order
+ * @param candidates Receives the addresses with an open port, as strings
+ * @param max_candidates Size of candidates
+ * @param candidate_count Receives the number of candidates
+ * @param devices Receives the devices that answered a probe
+ * @param max_devices Size of devices
+ * @return Number of devices found, or -1 on error
+ */
+int onvif_discovery_sweep(uint32_t first_ip, uint32_t last_ip, uint32_t broadcast,
+                          char candidates[][16], int max_candidates, int *candidate_count,
+                          onvif_device_info_t *devices, int max_devices);
+
+#endif /* ONVIF_DISCOVERY_SWEEP_H */
@@ -0,0 +1,115 @@
+#ifndef ONVIF_XML_H
+#define ONVIF_XML_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Pull parser for ONVIF SOAP responses
+ *
+ * Walks a response buffer once and reports start tags, end tags and text
+ * without building a tree or allocating. Names are matched without their
+ * namespace prefix, so "trt:MediaUri" and "MediaUri" are the same element,
+ * whichever prefixes the camera's SOAP stack picked. Elements nested deeper
+ * than ONVIF_XML_MAX_DEPTH are walked but never match a path.
+ */
+
+// Element nesting the reader keeps track of
+#define ONVIF_XML_MAX_DEPTH 32
+
+typedef enum {
+    ONVIF_XML_START,    // Start tag, also reported for <empty/> elements
+    ONVIF_XML_END,      // End tag, also reported right after <empty/> elements
+    ONVIF_XML_TEXT,     // Text of the current element, whitespace-only text is skipped
+    ONVIF_XML_EOF,      // End of the buffer
+    ONVIF_XML_ERROR     // Malformed input
+} onvif_xml_event_t;
+
+// Slice of the response buffer
+typedef struct {
+    const char *ptr;
+    size_t len;
+} onvif_xml_slice_t;
+
+typedef struct {
+    const char *pos;
+    const char *end;
+    int depth;                                      // Depth of the current element, 0 outside the root
+    onvif_xml_slice_t stack[ONVIF_XML_MAX_DEPTH];   // Local names of the open elements
+    onvif_xml_slice_t attrs;                        // Attribute text of the last start tag
+    onvif_xml_slice_t text;                         // Raw text of the last text event
+    bool close_empty;                               // Last start tag was <empty/>
+    bool pop_pending;                               // Last event was an end tag
+} onvif_xml_reader_t;
+
+/**
+ * Start reading a buffer
+ *
+ * @param reader Reader
+ * @param xml Buffer, must outlive the reader
+ * @param len Length of the buffer
+ */
+void onvif_xml_init(onvif_xml_reader_t *reader, const char *xml, size_t len);
+
+/**
+ * Read up to the next event
+ *
+ * @param reader Reader
+ * @return Event
+ */
+onvif_xml_event_t onvif_xml_next(onvif_xml_reader_t *reader);
+
+/**
+ * Check the local name of the current element
+ *
+ * @param reader Reader
+ * @param name Local name, without namespace prefix
+ * @return true if the current element has this name
+ */
+bool onvif_xml_name_is(const onvif_xml_reader_t *reader, const char *name);
+
+/**
+ * Check the innermost elements against a path
+ *
+ * @param reader Reader
+ * @param path Local names separated by '/', e.g. "MediaUri/Uri", matched
+ *             against the current element and its parents
+ * @return true if the path matches
+ */
+bool onvif_xml_path_is(const onvif_xml_reader_t *reader, const char *path);
+
+/**
+ * Copy the text of the last text event
+ * Entities are decoded and surrounding whitespace is trimmed.
+ *
+ * @param reader Reader
+ * @param buffer Buffer to fill, always terminated
+ * @param size Size of buffer
+ * @return Length of the copied text
+ */
+size_t onvif_xml_copy_text(const onvif_xml_reader_t *reader, char *buffer, size_t size);
+
+/**
+ * Copy an attribute of the last start tag
+ *
+ * @param reader Reader
+ * @param name Local name of the attribute
+ * @param buffer Buffer to fill, always terminated
+ * @param size Size of buffer
+ * @return true if the attribute was found
+ */
+bool onvif_xml_copy_attr(const onvif_xml_reader_t *reader, const char *name, char *buffer, size_t size);
+
+/**
+ * Find the text of the first element matching a path
+ *
+ * @param xml Buffer
+ * @param len Length of the buffer
+ * @param path Path as for onvif_xml_path_is()
+ * @param buffer Buffer to fill, always terminated
+ * @param size Size of buffer
+ * @return true if a matching element with text was found
+ */
+bool onvif_xml_find_text(const char *xml, size_t len, const char *path, char *buffer, size_t size);
+
+#endif /* ONVIF_XML_H */
@@ -0,0 +1,64 @@
+/**
+ * Packet Activity
+ *
+ * Estimates from compressed packet sizes alone whether anything moves in a
+ * stream. A static scene costs the encoder little beyond each key frame, so
+ * its other packets keep close to a steady size; motion makes them grow.
+ * The estimator keeps a slow average of the non-key packet sizes of a
+ * stream and of their spread around it, and flags the stream as active
+ * while a fast average of the last few packets stands out from that
+ * baseline. The threshold therefore follows each stream's own bitrate and
+ * noise, and nothing is decoded.
+ *
+ * Like stream_counters_t, each estimator has a single writer (the ingest
+ * thread of the stream); readers only load the time of the last activity.
+ */
+
+#ifndef LIGHTNVR_PACKET_ACTIVITY_H
+#define LIGHTNVR_PACKET_ACTIVITY_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct {
+    // Written only by the ingest thread
+    float mean;                         // Slow average of non-key packet sizes
+    float deviation;                    // Slow average of their distance from the mean
+    float recent;                       // Fast average of the last few packets
+    uint32_t samples;                   // Packets seen since the last reset
+
+    atomic_int_fast64_t last_active_ms; // Wall-clock time of the last packet that stood out
+} packet_activity_t;
+
+/**
+ * Start learning the baseline over, e.g. after a reconnect
+ * The stream counts as active until the baseline is learnt.
+ *
+ * @param activity Estimator
+ * @param now_ms Current wall-clock time in milliseconds
+ */
+void packet_activity_reset(packet_activity_t *activity, int64_t now_ms);
+
+/**
+ * Account for a video packet that is not a key frame; only the owning
+ * thread may call this
+ *
+ * @param activity Estimator
+ * @param size Packet size in bytes
+ * @param now_ms Current wall-clock time in milliseconds
+ * @return true if the packet counts as activity
+ */
+bool packet_activity_update(packet_activity_t *activity, int size, int64_t now_ms);
+
+/**
+ * Check whether a stream showed activity recently
+ *
+ * @param activity Estimator
+ * @param now_ms Current wall-clock time in milliseconds
+ * @param hold_ms How long activity counts after the last packet that stood out
+ * @return true if active within hold_ms
+ */
+bool packet_activity_recent(const packet_activity_t *activity, int64_t now_ms, int64_t hold_ms);
+
+#endif /* LIGHTNVR_PACKET_ACTIVITY_H */
@@ -0,0 +1,149 @@
+/**
+ * Packet and Frame Pool
+ *
+ * Per-stream free lists of AVPacket and AVFrame shells plus size-classed
+ * av_buffer_pool payload buffers, shared by the ingest reader, the HLS and
+ * MP4 writers and the detection decoder of a stream. At 30 fps per camera the
+ * read and write loops otherwise allocate and free several small structures
+ * per packet, which shows up both as CPU time and as heap fragmentation with
+ * musl's allocator.
+ *
+ * Pools live in a static table and are never freed while the process runs,
+ * so a pool pointer stays valid for the lifetime of any thread holding it.
+ * Every function accepts a NULL pool and then behaves like the plain FFmpeg
+ * allocator it replaces.
+ */
+
+#ifndef LIGHTNVR_PACKET_POOL_H
+#define LIGHTNVR_PACKET_POOL_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/buffer.h>
+#include <libavutil/frame.h>
+#include "core/config.h"
+
+// Free packet shells kept per stream (covers the ingest queues of all consumers)
+#define PACKET_POOL_MAX_PACKETS 512
+
+// Free frame shells kept per stream
+#define PACKET_POOL_MAX_FRAMES 8
+
+// Payload size classes: powers of two from 4 KB to 4 MB
+#define PACKET_POOL_MIN_PAYLOAD_SHIFT 12
+#define PACKET_POOL_PAYLOAD_CLASSES 11
+
+/**
+ * Pool counters
+ * A hit is a request served from the pool, a miss one that had to allocate.
+ */
+typedef struct {
+    uint64_t packet_hits;
+    uint64_t packet_misses;
+    uint64_t frame_hits;
+    uint64_t frame_misses;
+    uint64_t payload_hits;
+    uint64_t payload_misses;
+    int packets_free;             // Packet shells currently pooled
+    int frames_free;              // Frame shells currently pooled
+} packet_pool_stats_t;
+
+/**
+ * Pool of one stream
+ */
+typedef struct packet_pool {
+    char stream_name[MAX_STREAM_NAME];
+    bool in_use;
+    bool closed;                  // Set on shutdown; returned shells are freed
+
+    pthread_mutex_t mutex;        // Protects the free lists and payload pools
+    AVPacket *packets[PACKET_POOL_MAX_PACKETS];
+    int packet_count;
+    AVFrame *frames[PACKET_POOL_MAX_FRAMES];
+    int frame_count;
+    AVBufferPool *payloads[PACKET_POOL_PAYLOAD_CLASSES];
+
+    atomic_uint_fast64_t packet_requests;
+    atomic_uint_fast64_t packet_misses;
+    atomic_uint_fast64_t frame_requests;
+    atomic_uint_fast64_t frame_misses;
+    atomic_uint_fast64_t payload_requests;
+    atomic_uint_fast64_t payload_misses;
+} packet_pool_t;
+
+/**
+ * Get the pool of a stream, creating it on first use
+ *
+ * @param stream_name Name of the stream
+ * @return Pool, or NULL if the table is full (callers then allocate directly)
+ */
+packet_pool_t *packet_pool_acquire(const char *stream_name);
+
+/**
+ * Get an empty packet
+ *
+ * @param pool Pool (may be NULL)
+ * @return Packet or NULL on allocation failure
+ */
+AVPacket *packet_pool_get_packet(packet_pool_t *pool);
+
+/**
+ * Unreference a packet and return it to the pool
+ *
+ * @param pool Pool (may be NULL)
+ * @param pkt Packet to release; set to NULL
+ */
+void packet_pool_put_packet(packet_pool_t *pool, AVPacket **pkt);
+
+/**
+ * Allocate a padded payload for an empty packet, like av_new_packet
+ *
+ * @param pool Pool (may be NULL)
+ * @param pkt Packet without a payload
+ * @param size Payload size in bytes
+ * @return 0 on success, negative AVERROR on failure
+ */
+int packet_pool_new_payload(packet_pool_t *pool, AVPacket *pkt, int size);
+
+/**
+ * Get an empty frame
+ *
+ * @param pool Pool (may be NULL)
+ * @return Frame or NULL on allocation failure
+ */
+AVFrame *packet_pool_get_frame(packet_pool_t *pool);
+
+/**
+ * Unreference a frame and return it to the pool
+ *
+ * @param pool Pool (may be NULL)
+ * @param frame Frame to release; set to NULL
+ */
+void packet_pool_put_frame(packet_pool_t *pool, AVFrame **frame);
+
+/**
+ * Get the counters of a stream's pool
+ *
+ * @param stream_name Name of the stream
+ * @param stats Receives the counters
+ * @return 0 on success, -1 if the stream has no pool
+ */
+int packet_pool_get_stats(const char *stream_name, packet_pool_stats_t *stats);
+
+/**
+ * Get the counters summed over all pools
+ *
+ * @param stats Receives the counters
+ */
+void packet_pool_get_total_stats(packet_pool_stats_t *stats);
+
+/**
+ * Release all pooled memory
+ * Pools stay usable afterwards but stop caching.
+ */
+void packet_pool_cleanup(void);
+
+#endif /* LIGHTNVR_PACKET_POOL_H */
@@ -0,0 +1,168 @@
+/**
+ * Lock-free Packet Ring
+ *
+ * Bounded single-producer/single-consumer ring of refcounted AVPacket
+ * references. The producer (a stream reader) never blocks: when the consumer
+ * falls behind, packets are shed according to a GOP-aware drop policy.
+ *
+ * Drop policy:
+ * - Above the high watermark, non-key video frames are dropped together with
+ *   the rest of their GOP; key frames are still admitted while there is room.
+ * - When the ring is full, the whole GOP is dropped, including its key frame.
+ * In both cases delivery resumes on the next video key frame, so the consumer
+ * never receives a GOP with missing reference frames.
+ */
+
+#ifndef LIGHTNVR_PACKET_RING_H
+#define LIGHTNVR_PACKET_RING_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <libavcodec/avcodec.h>
+#include "video/packet_pool.h"
+#include "core/pipeline_trace.h"
+
+/**
+ * One slot of the ring
+ */
+typedef struct {
+    AVPacket *pkt;            // Packet reference, NULL when the slot is empty
+    void *opaque;             // Caller data travelling with the packet
+    pipeline_trace_t trace;   // Latency trace context of the packet
+} packet_ring_entry_t;
+
+/**
+ * Ring counters
+ */
+typedef struct {
+    uint64_t packets_pushed;  // Packets accepted by the ring
+    uint64_t packets_dropped; // Packets shed by the drop policy
+    uint64_t gops_dropped;    // GOPs dropped entirely because the ring was full
+    uint64_t overruns;        // Number of times the drop policy kicked in
+    int capacity;             // Ring capacity in packets
+    int used;                 // Packets currently queued
+} packet_ring_stats_t;
+
+/**
+ * Single-producer/single-consumer packet ring
+ */
+typedef struct {
+    packet_ring_entry_t *entries;
+    unsigned int capacity;            // Power of two
+    unsigned int mask;
+    unsigned int high_watermark;      // Fill level above which non-key frames are shed
+
+    atomic_uint head;                 // Next slot to read, written by the consumer only
+    atomic_uint tail;                 // Next slot to write, written by the producer only
+
+    bool dropping;                    // Producer is skipping until the next key frame
+    packet_pool_t *pool;              // Source of the packet shells (may be NULL)
+
+    // Wakeup for a consumer waiting on an empty ring; the producer only takes
+    // the mutex when a consumer is actually waiting
+    atomic_int waiting;
+    atomic_int closed;
+    pthread_mutex_t wait_mutex;
+    pthread_cond_t wait_cond;
+
+    atomic_uint_fast64_t packets_pushed;
+    atomic_uint_fast64_t packets_dropped;
+    atomic_uint_fast64_t gops_dropped;
+    atomic_uint_fast64_t overruns;
+} packet_ring_t;
+
+/**
+ * Initialize a packet ring
+ *
+ * @param ring Ring to initialize
+ * @param depth Requested depth in packets, rounded up to a power of two
+ * @param pool Pool providing the packet shells (may be NULL)
+ * @return 0 on success, -1 on failure
+ */
+int packet_ring_init(packet_ring_t *ring, int depth, packet_pool_t *pool);
+
+/**
+ * Release all queued packets and free the ring storage
+ * Must only be called once neither side uses the ring any more.
+ *
+ * @param ring Ring to destroy
+ * @param release_opaque Called for the opaque pointer of every queued entry (may be NULL)
+ */
+void packet_ring_destroy(packet_ring_t *ring, void (*release_opaque)(void *opaque));
+
+/**
+ * Queue a reference to a packet (producer side)
+ *
+ * @param ring Ring
+ * @param pkt Packet to reference; the caller keeps ownership of it
+ * @param is_video Whether the packet belongs to the video stream
+ * @param opaque Caller data stored with the packet when it is accepted
+ * @param trace Trace context stored with the packet (may be NULL for untraced packets)
+ * @return 0 if queued, 1 if dropped by the drop policy, -1 on error
+ */
+int packet_ring_push(packet_ring_t *ring, const AVPacket *pkt, bool is_video, void *opaque,
+                     const pipeline_trace_t *trace);
+
+/**
+ * Look at the oldest entry without removing it (consumer side)
+ *
+ * @param ring Ring
+ * @return Oldest entry or NULL if the ring is empty
+ */
+packet_ring_entry_t *packet_ring_peek(packet_ring_t *ring);
+
+/**
+ * Remove the oldest entry (consumer side)
+ *
+ * @param ring Ring
+ * @param pkt Packet receiving the queued reference (may be NULL to discard it)
+ * @param opaque Receives the entry's opaque pointer (may be NULL)
+ * @param trace Receives the entry's trace context (may be NULL)
+ * @return 0 on success, -1 if the ring is empty
+ */
+int packet_ring_pop(packet_ring_t *ring, AVPacket *pkt, void **opaque, pipeline_trace_t *trace);
+
+/**
+ * Wait until the ring has a packet or is closed (consumer side)
+ *
+ * @param ring Ring
+ * @param timeout_ms Maximum time to wait in milliseconds
+ * @return true if a packet is available
+ */
+bool packet_ring_wait(packet_ring_t *ring, int timeout_ms);
+
+/**
+ * Close the ring and wake a waiting consumer
+ * Packets already queued can still be read.
+ *
+ * @param ring Ring
+ */
+void packet_ring_close(packet_ring_t *ring);
+
+/**
+ * Check whether the ring has been closed
+ *
+ * @param ring Ring
+ * @return true if closed
+ */
+bool packet_ring_is_closed(packet_ring_t *ring);
+
+/**
+ * Get the number of queued packets
+ *
+ * @param ring Ring
+ * @return Number of queued packets
+ */
+int packet_ring_count(packet_ring_t *ring);
+
+/**
+ * Get the ring counters
+ *
+ * @param ring Ring
+ * @param stats Counters to fill
+ */
+void packet_ring_get_stats(packet_ring_t *ring, packet_ring_stats_t *stats);
+
+#endif /* LIGHTNVR_PACKET_RING_H */
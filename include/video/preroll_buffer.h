@@ -0,0 +1,112 @@
+/**
+ * Pre-detection Buffer
+ *
+ * Keeps the last few seconds of compressed packets of a stream in memory so
+ * that event recordings can start before the detection that triggered them.
+ * The buffer always starts on a video key frame and is trimmed one whole GOP
+ * at a time, so its contents can be muxed as-is.
+ *
+ * With the GOP cache enabled, a buffer that is set to no duration still
+ * keeps the newest GOP, so new live consumers can start from a key frame.
+ */
+
+#ifndef LIGHTNVR_PREROLL_BUFFER_H
+#define LIGHTNVR_PREROLL_BUFFER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <libavcodec/avcodec.h>
+#include "video/packet_pool.h"
+
+// Upper bound on the memory a single pre-detection buffer may use
+#define PREROLL_MAX_BYTES (32 * 1024 * 1024)
+
+typedef struct preroll_entry {
+    AVPacket *pkt;
+    void *opaque;                 // Caller data travelling with the packet
+    bool gop_start;               // Video key frame starting a GOP
+    int64_t ts_us;                // Video timestamp in microseconds (video packets only)
+    struct preroll_entry *next;
+} preroll_entry_t;
+
+/**
+ * GOP-aligned packet buffer covering at least a configured duration
+ */
+typedef struct {
+    preroll_entry_t *head;
+    preroll_entry_t *tail;
+    int count;                    // Packets buffered
+    int gop_count;                // GOPs buffered
+    size_t bytes;                 // Payload bytes buffered
+    int seconds;                  // Duration to cover (0 keeps only the GOP cache, if any)
+    bool gop_cache;               // Always keep the newest GOP
+    int64_t newest_video_us;      // Timestamp of the newest video packet
+    void (*release_opaque)(void *opaque);
+    packet_pool_t *pool;          // Source of the packet shells (may be NULL)
+} preroll_buffer_t;
+
+/**
+ * Initialize a pre-detection buffer
+ *
+ * @param buffer Buffer to initialize
+ * @param seconds Duration to keep in seconds (0 disables buffering)
+ * @param release_opaque Called for the opaque pointer of each dropped entry (may be NULL)
+ * @param pool Pool providing the packet shells (may be NULL)
+ */
+void preroll_buffer_init(preroll_buffer_t *buffer, int seconds, void (*release_opaque)(void *opaque),
+                         packet_pool_t *pool);
+
+/**
+ * Change the duration kept by the buffer
+ *
+ * @param buffer Buffer
+ * @param seconds Duration to keep in seconds (0 clears the buffer unless it keeps the GOP cache)
+ */
+void preroll_buffer_set_duration(preroll_buffer_t *buffer, int seconds);
+
+/**
+ * Keep the newest GOP even when no duration is set
+ *
+ * @param buffer Buffer
+ * @param enabled Whether to keep the newest GOP (disabling clears a buffer without duration)
+ */
+void preroll_buffer_set_gop_cache(preroll_buffer_t *buffer, bool enabled);
+
+/**
+ * Check whether the buffer keeps packets at all
+ *
+ * @param buffer Buffer
+ * @return true if a duration or the GOP cache is set
+ */
+bool preroll_buffer_enabled(const preroll_buffer_t *buffer);
+
+/**
+ * Get the start of the newest GOP in the buffer
+ *
+ * @param buffer Buffer
+ * @return Entry of the newest key frame, or NULL if the buffer is empty
+ */
+preroll_entry_t *preroll_buffer_newest_gop(const preroll_buffer_t *buffer);
+
+/**
+ * Add a reference to a packet, dropping whole GOPs that are no longer needed
+ *
+ * @param buffer Buffer
+ * @param pkt Packet to reference; the caller keeps ownership of it
+ * @param is_video Whether the packet belongs to the video stream
+ * @param time_base Time base of the packet's stream
+ * @param opaque Caller data stored with the packet when it is accepted
+ * @return 0 if buffered, 1 if skipped (no key frame yet or disabled), -1 on error
+ */
+int preroll_buffer_add(preroll_buffer_t *buffer, const AVPacket *pkt, bool is_video,
+                       AVRational time_base, void *opaque);
+
+/**
+ * Release every buffered packet
+ *
+ * @param buffer Buffer
+ */
+void preroll_buffer_clear(preroll_buffer_t *buffer);
+
+#endif /* LIGHTNVR_PREROLL_BUFFER_H */
@@ -0,0 +1,58 @@
+/**
+ * Per-host reconnect coordination
+ *
+ * Streams from one multi-channel encoder or NVR share a host. When that host
+ * goes away, every stream of it would otherwise probe and reconnect on its
+ * own schedule, so the host is hit by all of them at once when it comes back.
+ *
+ * The manager keeps one entry per host and port. Reachability is probed once
+ * per host and the result is shared with every stream asking in the meantime.
+ * While the host is unreachable its streams back off together, exponentially
+ * and with jitter; once it answers again they are released one at a time,
+ * a short interval apart, instead of all at once.
+ *
+ * Only the probe decides whether a host is down. A stream that fails to open
+ * on a reachable host (a wrong path, a bad password) backs off on its own and
+ * does not hold back the other streams of the host.
+ */
+
+#ifndef LIGHTNVR_RECONNECT_MANAGER_H
+#define LIGHTNVR_RECONNECT_MANAGER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Extract the host and port a URL connects to
+ *
+ * @param url Stream URL
+ * @param host Buffer receiving the host name
+ * @param size Size of the buffer
+ * @param port Receives the port, the default of the scheme if none is given
+ * @return 0 on success, -1 if the URL has no host or an unknown scheme
+ */
+int reconnect_manager_host(const char *url, char *host, size_t size, int *port);
+
+/**
+ * Check whether the host of a URL can be reconnected to
+ * Probes the host unless a probe finished only a moment ago or is running
+ * for another stream, in which case its result is used. URLs without a
+ * known host are always reported reachable.
+ *
+ * @param url Stream URL
+ * @param release_ms Receives how long to wait before connecting while the
+ *                   host's streams are being released after it came back
+ * @return true if the host is reachable
+ */
+bool reconnect_manager_probe(const char *url, int *release_ms);
+
+/**
+ * Get the delay before the next reconnect attempt of a stream
+ *
+ * @param url Stream URL
+ * @param delay_ms Backoff of the stream itself
+ * @return The larger of delay_ms and the backoff of the host, with jitter
+ */
+int reconnect_manager_delay(const char *url, int delay_ms);
+
+#endif /* LIGHTNVR_RECONNECT_MANAGER_H */
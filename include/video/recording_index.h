@@ -0,0 +1,74 @@
+/**
+ * Recording Keyframe Index
+ *
+ * A fragmented MP4 recording can be played from any fragment starting on a
+ * key frame by sending its ftyp and moov boxes followed by the file from
+ * that fragment's moof box on. When a recording is finished, those
+ * fragments are listed in a sidecar file beside it (<name>.kfi) with their
+ * start time and offset, so finding the fragment covering a time takes a
+ * binary search over a few reads instead of walking the whole file.
+ * Fragments cut by frag_duration in the middle of a GOP are left out.
+ *
+ * Recordings written as a single fragment or with the moov box at the end
+ * have nothing to index.
+ */
+
+#ifndef LIGHTNVR_RECORDING_INDEX_H
+#define LIGHTNVR_RECORDING_INDEX_H
+
+#include <stdint.h>
+
+// Fragment of a recording
+typedef struct {
+    int64_t time_ms;        // Start of the fragment, from the start of the recording
+    uint64_t offset;        // Offset of its moof box in the file
+} recording_index_entry_t;
+
+// Whole index of a recording
+typedef struct {
+    recording_index_entry_t *entries;
+    uint32_t count;
+    uint64_t init_size;     // Size of the boxes before the first fragment
+    uint64_t file_size;     // Size of the recording
+    int64_t duration_ms;    // End of the last fragment, 0 if unknown
+} recording_index_t;
+
+/**
+ * Build the keyframe index of a finished recording
+ *
+ * @param mp4_path Recording file
+ * @return Number of fragments indexed, -1 if the file cannot be indexed
+ */
+int recording_index_build(const char *mp4_path);
+
+/**
+ * Find the fragment covering a time in a recording
+ * The index is built first if it is missing or older than the file.
+ *
+ * @param mp4_path Recording file
+ * @param time_ms Time from the start of the recording
+ * @param entry Receives the last fragment starting at or before time_ms
+ * @param init_size Receives the size of the boxes before the first fragment
+ * @return 0 on success, -1 if the recording has no index
+ */
+int recording_index_find(const char *mp4_path, int64_t time_ms, recording_index_entry_t *entry,
+                         uint64_t *init_size);
+
+/**
+ * Load the whole index of a recording
+ * The index is built first if it is missing or older than the file.
+ *
+ * @param mp4_path Recording file
+ * @param index Receives the index, to release with recording_index_free()
+ * @return 0 on success, -1 if the recording has no index
+ */
+int recording_index_load(const char *mp4_path, recording_index_t *index);
+
+/**
+ * Free an index loaded by recording_index_load()
+ *
+ * @param index Index
+ */
+void recording_index_free(recording_index_t *index);
+
+#endif /* LIGHTNVR_RECORDING_INDEX_H */
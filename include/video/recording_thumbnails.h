@@ -0,0 +1,75 @@
+/**
+ * Recording Thumbnails
+ *
+ * Once a recording is finished, a background job on the detection workers
+ * extracts a thumbnail from the key frame in its middle and, when
+ * thumbnail_sprite_interval is set, a sprite sheet with one tile every that
+ * many seconds plus a WebVTT index for scrubbing. Only key frames are
+ * decoded. The images are stored next to the MP4:
+ *
+ *   recording_20240101_120000.mp4
+ *   recording_20240101_120000.thumb.jpg
+ *   recording_20240101_120000.sprite.jpg
+ *   recording_20240101_120000.sprite.vtt
+ *
+ * recording_thumbnails_remove() also deletes the keyframe index written
+ * beside them by recording_index.h.
+ */
+
+#ifndef LIGHTNVR_RECORDING_THUMBNAILS_H
+#define LIGHTNVR_RECORDING_THUMBNAILS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Thumbnail width; the height follows the aspect ratio
+#define RECORDING_THUMBNAIL_WIDTH 320
+
+// Sprite tile width, and tiles per sprite row
+#define RECORDING_SPRITE_TILE_WIDTH 160
+#define RECORDING_SPRITE_COLUMNS 10
+
+// Tiles per sprite at most; longer recordings get a wider tile interval
+#define RECORDING_SPRITE_MAX_TILES 100
+
+#define RECORDING_THUMBNAIL_QUALITY 70
+
+// Files derived from a recording
+typedef enum {
+    RECORDING_THUMBNAIL,
+    RECORDING_SPRITE,
+    RECORDING_SPRITE_VTT,
+    RECORDING_KEYFRAME_INDEX        // See recording_index.h
+} recording_thumbnail_kind_t;
+
+/**
+ * Path of a file derived from a recording
+ *
+ * @param mp4_path Recording file
+ * @param kind File to name
+ * @param path Buffer receiving the path
+ * @param size Size of the buffer
+ * @return 0 on success, -1 if the path does not fit
+ */
+int recording_thumbnails_path(const char *mp4_path, recording_thumbnail_kind_t kind,
+                              char *path, size_t size);
+
+/**
+ * Queue thumbnail and sprite generation for a finished recording
+ * Does nothing if thumbnails are disabled or the recording is queued
+ * already. Files that exist are not generated again.
+ *
+ * @param recording_id Recording ID, referenced from the sprite index
+ * @param mp4_path Recording file
+ * @return 0 if queued or already queued, -1 otherwise
+ */
+int recording_thumbnails_queue(uint64_t recording_id, const char *mp4_path);
+
+/**
+ * Delete the files derived from a recording
+ *
+ * @param mp4_path Recording file
+ */
+void recording_thumbnails_remove(const char *mp4_path);
+
+#endif /* LIGHTNVR_RECORDING_THUMBNAILS_H */
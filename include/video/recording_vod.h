@@ -0,0 +1,89 @@
+/**
+ * Recording VOD
+ *
+ * Serves recordings as HLS video on demand with fMP4 segments, so players
+ * only fetch the part they watch. Segments start on key frames and last
+ * about RECORDING_VOD_SEGMENT_MS. A playlist covers one recording or a
+ * time range spanning several, with a discontinuity between recordings.
+ *
+ * Recordings with a keyframe index (recording_index.h) are fragmented MP4
+ * already, so their initialization section and segments are byte ranges of
+ * the file, listed with EXT-X-BYTERANGE and served by sendfile through
+ * /api/recordings/play/{id}. Other recordings are remuxed with stream copy
+ * when a segment is requested, from the key frames in the demuxer's index,
+ * and the generated segments are kept in a small LRU cache. Recordings made
+ * of HLS segments (hls_recording.h) list their own files, which are
+ * served as they are.
+ *
+ * With [hardware] transcode_hevc, playlists asked for H.264 list HEVC
+ * recordings as segments transcoded to H.264 when requested, for browsers
+ * that cannot play HEVC. The recordings stay HEVC on disk; the transcoded
+ * segments are cut like remuxed ones and kept in the same cache.
+ *
+ * Resource names of remuxed recordings, relative to /api/recordings/vod/{id}/:
+ *   index.m3u8        Media playlist of the recording
+ *   init.mp4          Initialization section (EXT-X-MAP)
+ *   {n}.m4s           Segment n of the recording
+ *   h264/init.mp4     Same, for HEVC recordings transcoded to H.264
+ *   h264/{n}.m4s
+ */
+
+#ifndef LIGHTNVR_RECORDING_VOD_H
+#define LIGHTNVR_RECORDING_VOD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <libavutil/buffer.h>
+
+// Segments are cut on the first key frame after this long
+#define RECORDING_VOD_SEGMENT_MS 6000
+
+// Remuxed segments and initialization sections kept, and their total size
+#define RECORDING_VOD_CACHE_ENTRIES 32
+#define RECORDING_VOD_CACHE_BYTES (64 * 1024 * 1024)
+
+#define RECORDING_VOD_INIT_NAME "init.mp4"
+#define RECORDING_VOD_H264_DIR "h264/"
+
+// Returned when a transcoded resource has to wait for a free encoder
+#define RECORDING_VOD_BUSY (-2)
+
+// Recording, or part of one, in a playlist
+typedef struct {
+    uint64_t id;
+    const char *file_path;  // Located file of the recording
+    time_t start_time;      // Wall clock time the recording starts at
+    int64_t from_ms;        // Offset to start at, 0 for the beginning
+    int64_t to_ms;          // Offset to stop at, 0 for the end
+    bool h264;              // List HEVC video as transcoded H.264 segments
+} recording_vod_item_t;
+
+/**
+ * Generate the media playlist of recordings played one after the other
+ * Recordings that cannot be read are left out.
+ *
+ * @param items Recordings in playback order
+ * @param count Number of recordings
+ * @param length Receives the length of the playlist
+ * @return Playlist to release with free, or NULL if no recording has any media
+ */
+char *recording_vod_build_playlist(const recording_vod_item_t *items, int count, size_t *length);
+
+/**
+ * Get the initialization section or a segment of a remuxed or HLS recording
+ *
+ * @param id Recording ID
+ * @param file_path Located file of the recording
+ * @param file_name Resource name, RECORDING_VOD_INIT_NAME or {n}.m4s, optionally
+ *                  prefixed with RECORDING_VOD_H264_DIR
+ * @param data Receives a new reference to the data; release it with av_buffer_unref
+ * @return 0 on success, RECORDING_VOD_BUSY if all software encoders are in use,
+ *         -1 if the resource does not exist or cannot be made
+ */
+int recording_vod_get_resource(uint64_t id, const char *file_path, const char *file_name,
+                               AVBufferRef **data);
+
+#endif /* LIGHTNVR_RECORDING_VOD_H */
@@ -0,0 +1,82 @@
+/**
+ * Remote Inference Client
+ *
+ * Offloads detection to an inference server over a persistent connection
+ * speaking a small framed binary protocol (docs/REMOTE_DETECTION.md): a
+ * JPEG frame goes out, a detection list comes back. Streams using the same
+ * server share one connection, on which any number of requests may be
+ * outstanding; responses are matched to requests by id.
+ */
+
+#ifndef LIGHTNVR_REMOTE_DETECTION_H
+#define LIGHTNVR_REMOTE_DETECTION_H
+
+#include "video/detection_result.h"
+#include "video/detection_model.h"
+
+typedef struct remote_connection remote_connection_t;
+
+/**
+ * Find the server address in a model path
+ * Relative model paths get the models directory prepended, so the address
+ * is looked for anywhere in the path.
+ *
+ * @param model_path Model path, e.g. "tcp://gpu-node:7070" or "unix:///run/infer.sock"
+ * @return Start of the address in model_path, or NULL if it names no server
+ */
+const char *remote_detection_address(const char *model_path);
+
+/**
+ * Get the connection to an inference server
+ * The connection is shared with every other user of the same address and
+ * established on first use; a server that is down is retried on later
+ * detections.
+ *
+ * @param address Server address, "tcp://host:port" or "unix:///path"
+ * @return Connection handle, or NULL on an invalid address
+ */
+remote_connection_t *remote_detection_open(const char *address);
+
+/**
+ * Release a connection handle
+ * The connection closes when its last user releases it; requests still
+ * outstanding on it fail.
+ *
+ * @param conn Connection handle, may be NULL
+ */
+void remote_detection_close(remote_connection_t *conn);
+
+/**
+ * Run detection on the inference server
+ * Blocks until the response arrives or [remote_detection] timeout_ms
+ * passes; other requests on the connection proceed meanwhile.
+ *
+ * @param conn Connection handle
+ * @param frame_data Packed pixels
+ * @param width Frame width
+ * @param height Frame height
+ * @param channels 1 (gray), 3 (RGB) or 4 (RGBA)
+ * @param threshold Minimum confidence of the detections returned
+ * @param result Filled with the detections, coordinates normalized to 0-1
+ * @return 0 on success, -1 on failure
+ */
+int remote_detection_detect(remote_connection_t *conn, const unsigned char *frame_data,
+                            int width, int height, int channels, float threshold,
+                            detection_result_t *result);
+
+/**
+ * Run detection with a remote model
+ * Sends the frame to the model's server with the model's threshold.
+ *
+ * @param model Detection model handle of type MODEL_TYPE_REMOTE
+ * @param frame_data Packed pixels
+ * @param width Frame width
+ * @param height Frame height
+ * @param channels 1 (gray), 3 (RGB) or 4 (RGBA)
+ * @param result Filled with the detections
+ * @return 0 on success, -1 on failure
+ */
+int detect_with_remote_model(detection_model_t model, const unsigned char *frame_data,
+                             int width, int height, int channels, detection_result_t *result);
+
+#endif /* LIGHTNVR_REMOTE_DETECTION_H */
@@ -0,0 +1,96 @@
+/**
+ * Latest-Frame Snapshot Cache
+ *
+ * Keeps the newest frame the detection decoder produced for each stream and
+ * serves it as JPEG. A frame is only taken while someone asks for snapshots
+ * of the stream, at most once per SNAPSHOT_CACHE_INTERVAL_MS, and each
+ * requested size and quality is encoded at most once per interval no matter
+ * how many clients ask. A wall of refreshing dashboard tiles therefore costs
+ * one encode per interval instead of a decode per request. Live MJPEG asks
+ * for a shorter interval, which holds while it keeps asking.
+ */
+
+#ifndef LIGHTNVR_SNAPSHOT_CACHE_H
+#define LIGHTNVR_SNAPSHOT_CACHE_H
+
+#include <stdbool.h>
+#include <time.h>
+
+#include <libavutil/buffer.h>
+#include <libavutil/frame.h>
+
+// Frames are taken, and images re-encoded, at most this often
+#define SNAPSHOT_CACHE_INTERVAL_MS 1000
+
+// The decoder keeps supplying frames this long after the last request
+#define SNAPSHOT_CACHE_DEMAND_MS 30000
+
+// Images of different sizes or qualities kept per stream
+#define SNAPSHOT_CACHE_VARIANTS 4
+
+/**
+ * Whether the cache wants a new frame of a stream
+ * True while snapshots were requested recently and the cached frame is
+ * older than the interval. Lets a decoder that only decodes some frames
+ * decode one more for the cache.
+ *
+ * @param stream_name Stream name
+ * @return true if snapshot_cache_offer() would take a frame now
+ */
+bool snapshot_cache_wants_frame(const char *stream_name);
+
+/**
+ * Offer a decoded frame of a stream
+ * Cheap when the cache does not want one; otherwise the frame is
+ * referenced, or downloaded first if it is a hardware frame.
+ *
+ * @param stream_name Stream name
+ * @param frame Decoded frame
+ */
+void snapshot_cache_offer(const char *stream_name, const AVFrame *frame);
+
+/**
+ * Get the newest frame of a stream as JPEG
+ * Also marks the stream as wanted, so the first request for a stream may
+ * find no frame yet.
+ *
+ * @param stream_name Stream name
+ * @param width Image width, 0 for the frame's own; never scaled up
+ * @param quality JPEG quality from 1 to 100
+ * @param jpeg Set to a reference to the image, to release with av_buffer_unref()
+ * @param frame_time Set to when the frame was taken (optional)
+ * @return 0 on success, 1 if there is no frame yet, -1 on failure
+ */
+int snapshot_cache_get_jpeg(const char *stream_name, int width, int quality,
+                            AVBufferRef **jpeg, time_t *frame_time);
+
+/**
+ * Get the newest frame of a stream as JPEG, taking frames more often
+ * Like snapshot_cache_get_jpeg(), but frames are taken, and the image
+ * re-encoded, every interval_ms for as long as requests keep coming at
+ * about that rate. Each request after an interval may return a new image.
+ *
+ * @param stream_name Stream name
+ * @param width Image width, 0 for the frame's own; never scaled up
+ * @param quality JPEG quality from 1 to 100
+ * @param interval_ms Interval between frames, at most SNAPSHOT_CACHE_INTERVAL_MS
+ * @param jpeg Set to a reference to the image, to release with av_buffer_unref()
+ * @param frame_time Set to when the frame was taken (optional)
+ * @return 0 on success, 1 if there is no frame yet, -1 on failure
+ */
+int snapshot_cache_get_jpeg_every(const char *stream_name, int width, int quality, int interval_ms,
+                                  AVBufferRef **jpeg, time_t *frame_time);
+
+/**
+ * Drop the cached frame and images of a stream
+ *
+ * @param stream_name Stream name
+ */
+void snapshot_cache_close(const char *stream_name);
+
+/**
+ * Drop the cached frames and images of all streams
+ */
+void snapshot_cache_shutdown(void);
+
+#endif /* LIGHTNVR_SNAPSHOT_CACHE_H */
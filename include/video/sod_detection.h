@@ -4,6 +4,10 @@
 #include <stdbool.h>
 #include "video/detection_result.h"
 #include "video/detection_model.h"
+#include "video/tensor_kernels.h"
+
+// Suffix of the int8 weights sod_quantize writes next to a model (model.sod.int8)
+#define SOD_INT8_MODEL_SUFFIX ".int8"
 
 /**
  * Initialize the SOD detection system
@@ -19,6 +23,8 @@ void shutdown_sod_detection_system(void);
 
 /**
  * Load a SOD model
+ * When int8 weights (model_path + SOD_INT8_MODEL_SUFFIX) are present they
+ * are loaded as well, and the layers they cover run the int8 path.
  *
  * @param model_path Path to the model file
  * @param threshold Detection confidence threshold (0.0-1.0)
@@ -40,6 +46,29 @@ detection_model_t load_sod_model(const char *model_path, float threshold);
 int detect_with_sod_model(detection_model_t model, const unsigned char *frame_data,
                          int width, int height, int channels, detection_result_t *result);
 
+/**
+ * Check whether a model takes YUV 4:2:0 frames through
+ * detect_with_sod_model_yuv420
+ *
+ * @param model Detection model handle
+ * @return true for SOD models with a 3-channel input the model input kernels can produce
+ */
+bool sod_model_accepts_yuv420(detection_model_t model);
+
+/**
+ * Run detection on a YUV 4:2:0 frame using SOD
+ * The frame is resized and converted straight into the input tensor of the
+ * network, without the RGB frame and the float image detect_with_sod_model
+ * goes through. Box coordinates are normalized to the frame.
+ *
+ * @param model SOD model handle, accepted by sod_model_accepts_yuv420
+ * @param frame Frame planes
+ * @param result Pointer to detection result structure to fill
+ * @return 0 on success, non-zero on failure
+ */
+int detect_with_sod_model_yuv420(detection_model_t model, const yuv420_image_t *frame,
+                                 detection_result_t *result);
+
 /**
  * Check if SOD is available
  *
@@ -0,0 +1,68 @@
+/**
+ * Stream Arena
+ *
+ * Per-stream memory for the metadata objects a stream allocates while it
+ * runs (its state manager, the HLS thread context, MP4 writers). Blocks
+ * come out of a few large chunks owned by the stream; a freed block goes
+ * back on the stream's free list and is handed out again the next time an
+ * object of the same size is needed, so a camera that keeps reconnecting
+ * reuses the same memory instead of fragmenting the heap.
+ *
+ * All chunks are released together when the stream is removed. Blocks
+ * still in use at that point keep the chunks alive until the last one is
+ * freed. Every block carries a header and a trailing guard; freeing a
+ * block twice or a block whose guard was overwritten is logged and
+ * ignored instead of corrupting the heap.
+ */
+
+#ifndef LIGHTNVR_STREAM_ARENA_H
+#define LIGHTNVR_STREAM_ARENA_H
+
+#include <stddef.h>
+
+// Size of the chunks blocks are carved from; larger objects get a chunk of their own
+#define STREAM_ARENA_CHUNK_SIZE (32 * 1024)
+
+/**
+ * Allocate a zeroed block from the arena of a stream
+ * The arena is created on first use.
+ *
+ * @param stream_name Name of the stream the object belongs to
+ * @param size Size of the object
+ * @return Block, or NULL on error
+ */
+void *stream_arena_alloc(const char *stream_name, size_t size);
+
+/**
+ * Return a block to the arena it came from
+ *
+ * @param ptr Block from stream_arena_alloc(), may be NULL
+ */
+void stream_arena_free(void *ptr);
+
+/**
+ * Release the arena of a removed stream
+ * Chunks are freed now, or when the last block still in use is freed.
+ * A stream added later under the same name gets a new arena.
+ *
+ * @param stream_name Name of the stream
+ */
+void stream_arena_release(const char *stream_name);
+
+/**
+ * Get the memory held by the arena of a stream
+ *
+ * @param stream_name Name of the stream
+ * @param reserved Receives the size of its chunks (may be NULL)
+ * @param in_use Receives the size of the blocks in use (may be NULL)
+ * @return 0 on success, -1 if the stream has no arena
+ */
+int stream_arena_get_usage(const char *stream_name, size_t *reserved, size_t *in_use);
+
+/**
+ * Release all arenas, at shutdown
+ * Arenas with blocks still in use are released when their last block is freed.
+ */
+void stream_arena_shutdown(void);
+
+#endif /* LIGHTNVR_STREAM_ARENA_H */
@@ -0,0 +1,98 @@
+/**
+ * Stream Counters
+ *
+ * Per-packet statistics of a stream, kept in a cache-line-aligned block of
+ * atomics. Each block has a single writer (the ingest thread of the
+ * stream), which updates it with relaxed loads and stores instead of
+ * read-modify-write operations or a mutex. Readers (the API, metrics, the
+ * stream state manager) take relaxed loads; a snapshot is not consistent
+ * across fields, but every field is read whole.
+ */
+
+#ifndef LIGHTNVR_STREAM_COUNTERS_H
+#define LIGHTNVR_STREAM_COUNTERS_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+// Wall-clock times are in milliseconds, timestamps in the stream's time base
+typedef struct {
+    _Alignas(64) atomic_uint_fast64_t packets;  // Packets read from the input
+    atomic_uint_fast64_t bytes;                 // Bytes read from the input
+    atomic_uint_fast64_t frames;                // Video packets
+    atomic_uint_fast64_t keyframes;             // Video keyframes
+    atomic_uint_fast64_t drops;                 // Packets consumers could not keep up with
+    atomic_uint_fast64_t reconnects;            // Reconnections since start
+    atomic_uint_fast64_t lost;                  // RTP packets lost or too late, UDP inputs only
+    atomic_int_fast64_t jitter_us;              // Interarrival jitter of video packets, UDP inputs only
+    atomic_int_fast64_t last_pts;               // Of the last video packet
+    atomic_int_fast64_t last_dts;
+    atomic_int_fast64_t last_packet_ms;
+    atomic_int_fast64_t last_keyframe_ms;
+} stream_counters_t;
+
+// Plain copy of stream_counters_t
+typedef struct {
+    uint64_t packets;
+    uint64_t bytes;
+    uint64_t frames;
+    uint64_t keyframes;
+    uint64_t drops;
+    uint64_t reconnects;
+    uint64_t lost;
+    int64_t jitter_us;
+    int64_t last_pts;
+    int64_t last_dts;
+    int64_t last_packet_ms;
+    int64_t last_keyframe_ms;
+} stream_counters_snapshot_t;
+
+static inline void stream_counters_init(stream_counters_t *counters, int64_t no_timestamp) {
+    atomic_init(&counters->packets, 0);
+    atomic_init(&counters->bytes, 0);
+    atomic_init(&counters->frames, 0);
+    atomic_init(&counters->keyframes, 0);
+    atomic_init(&counters->drops, 0);
+    atomic_init(&counters->reconnects, 0);
+    atomic_init(&counters->lost, 0);
+    atomic_init(&counters->jitter_us, 0);
+    atomic_init(&counters->last_pts, no_timestamp);
+    atomic_init(&counters->last_dts, no_timestamp);
+    atomic_init(&counters->last_packet_ms, 0);
+    atomic_init(&counters->last_keyframe_ms, 0);
+}
+
+/**
+ * Add to a counter; only the owning thread may call this
+ */
+static inline void stream_counter_add(atomic_uint_fast64_t *counter, uint64_t value) {
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + value,
+                          memory_order_relaxed);
+}
+
+/**
+ * Set a value; only the owning thread may call this
+ */
+static inline void stream_counter_set(atomic_int_fast64_t *value, int64_t new_value) {
+    atomic_store_explicit(value, new_value, memory_order_relaxed);
+}
+
+static inline void stream_counters_read(const stream_counters_t *counters, stream_counters_snapshot_t *snapshot) {
+    // The loads do not modify the block, the casts only drop const for older compilers
+    stream_counters_t *c = (stream_counters_t *)counters;
+
+    snapshot->packets = atomic_load_explicit(&c->packets, memory_order_relaxed);
+    snapshot->bytes = atomic_load_explicit(&c->bytes, memory_order_relaxed);
+    snapshot->frames = atomic_load_explicit(&c->frames, memory_order_relaxed);
+    snapshot->keyframes = atomic_load_explicit(&c->keyframes, memory_order_relaxed);
+    snapshot->drops = atomic_load_explicit(&c->drops, memory_order_relaxed);
+    snapshot->reconnects = atomic_load_explicit(&c->reconnects, memory_order_relaxed);
+    snapshot->lost = atomic_load_explicit(&c->lost, memory_order_relaxed);
+    snapshot->jitter_us = atomic_load_explicit(&c->jitter_us, memory_order_relaxed);
+    snapshot->last_pts = atomic_load_explicit(&c->last_pts, memory_order_relaxed);
+    snapshot->last_dts = atomic_load_explicit(&c->last_dts, memory_order_relaxed);
+    snapshot->last_packet_ms = atomic_load_explicit(&c->last_packet_ms, memory_order_relaxed);
+    snapshot->last_keyframe_ms = atomic_load_explicit(&c->last_keyframe_ms, memory_order_relaxed);
+}
+
+#endif /* LIGHTNVR_STREAM_COUNTERS_H */
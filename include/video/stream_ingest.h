@@ -0,0 +1,360 @@
+/**
+ * Shared Stream Ingest
+ *
+ * One ingest per camera URL demuxes the RTSP (or other) input exactly once and
+ * fans the packets out to every registered consumer (HLS writer, MP4 recorder,
+ * detection). Each consumer gets its own lock-free ring of refcounted AVPacket
+ * references (see packet_ring.h), so nothing is copied and a slow consumer
+ * never blocks the reader or the other consumers.
+ *
+ * G.711 audio is transcoded to AAC here, once per stream, and consumers see
+ * the audio stream as AAC (see audio_transcode.h). Transcoding is skipped
+ * while every consumer is video-only and no pre-roll is kept.
+ *
+ * Stream parameters (codecpar, time_base, frame rate) are published as an
+ * immutable snapshot per connection. When the ingest reconnects and the
+ * snapshot changes, consumers are told via STREAM_INGEST_STREAMS_CHANGED so
+ * they can re-initialize their output.
+ */
+
+#ifndef LIGHTNVR_STREAM_INGEST_H
+#define LIGHTNVR_STREAM_INGEST_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include "core/config.h"
+#include "core/metrics.h"
+#include "core/pipeline_trace.h"
+#include "video/packet_activity.h"
+#include "video/packet_ring.h"
+#include "video/preroll_buffer.h"
+#include "video/stream_counters.h"
+
+// Maximum number of consumers that can attach to a single ingest
+#define MAX_INGEST_CONSUMERS 8
+
+// Returned by stream_ingest_read_packet when the ingest reconnected and the
+// input streams changed. The packet is kept queued for the next read.
+#define STREAM_INGEST_STREAMS_CHANGED FFERRTAG('I','N','G','C')
+
+/**
+ * Immutable snapshot of the input stream parameters for one connection
+ * The format context is never opened; it only carries AVStream copies so
+ * that consumers can keep using the existing (const AVStream *) APIs.
+ */
+typedef struct {
+    AVFormatContext *fmt_ctx;   // Shadow context holding copies of the input streams
+    int video_stream_idx;       // Index of the video stream (-1 if none)
+    int audio_stream_idx;       // Index of the audio stream (-1 if none)
+    int generation;             // Connection generation that produced this snapshot
+    atomic_int refcount;        // Released when the last queued packet and consumer drop it
+} stream_ingest_streams_t;
+
+/**
+ * Consumer statistics
+ */
+typedef struct {
+    uint64_t packets_delivered;   // Packets handed to the consumer
+    uint64_t packets_dropped;     // Packets shed because the consumer fell behind
+    uint64_t gops_dropped;        // GOPs dropped entirely because the queue was full
+    uint64_t overruns;            // Number of times the drop policy kicked in
+    int queue_depth;              // Configured queue depth
+    int queue_used;               // Packets currently queued
+} stream_ingest_consumer_stats_t;
+
+struct stream_ingest;
+
+/**
+ * Consumer attached to an ingest
+ */
+typedef struct stream_ingest_consumer {
+    char name[64];                      // Consumer name for logging (e.g. "hls", "mp4")
+    struct stream_ingest *ingest;       // Owning ingest
+
+    // Packet ring; the ingest thread is the only producer and the consumer
+    // thread the only reader. Each entry carries a stream snapshot reference.
+    packet_ring_t ring;
+
+    // Wakes stream_ingest_wait_for_streams when streams are published or on EOF
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+
+    // Stream snapshot currently in use; only touched by the consumer thread
+    stream_ingest_streams_t *current;
+    stream_ingest_streams_t *retired;   // Previous snapshot, released on the next read
+
+    atomic_bool eof;                    // Ingest is stopping
+    bool video_only;                    // Only video packets are queued
+
+    atomic_uint_fast64_t packets_delivered;
+    metric_t dropped_metric;            // Packets shed, per stream and consumer name
+    metric_t dequeue_metric;            // Age of packets when read, stage dequeue_<name>
+
+    // Trace context of the packet last returned by stream_ingest_read_packet()
+    pipeline_trace_t trace;
+} stream_ingest_consumer_t;
+
+/**
+ * Ingest statistics
+ */
+typedef struct {
+    uint64_t packets_read;        // Packets demuxed from the input
+    uint64_t bytes_read;          // Bytes demuxed from the input
+    uint64_t frames_read;         // Video packets demuxed from the input
+    uint64_t keyframes_read;      // Video keyframes demuxed from the input
+    uint64_t packets_dropped;     // Packets consumers fell too far behind to take
+    int reconnects;               // Number of reconnections since start
+    uint64_t packets_lost;        // RTP packets lost on the network, UDP inputs only
+    int64_t jitter_us;            // Interarrival jitter of video packets, UDP inputs only
+    int consumer_count;           // Currently attached consumers
+    bool connected;               // Whether the input is currently open
+    time_t last_packet_time;      // Wall-clock time of the last packet
+    time_t last_keyframe_time;    // Wall-clock time of the last video keyframe
+    int64_t last_pts;             // Timestamps of the last video packet, AV_NOPTS_VALUE before the first
+    int64_t last_dts;
+} stream_ingest_stats_t;
+
+/**
+ * Shared ingest for a single input URL
+ */
+typedef struct stream_ingest {
+    char stream_name[MAX_STREAM_NAME];
+    char url[MAX_URL_LENGTH];
+    int protocol;                 // STREAM_PROTOCOL_TCP or STREAM_PROTOCOL_UDP
+
+    pthread_t thread;
+    atomic_int running;
+    bool thread_started;
+
+    pthread_mutex_t mutex;        // Protects consumers and streams
+    stream_ingest_consumer_t *consumers[MAX_INGEST_CONSUMERS];
+    int consumer_count;
+    int audio_consumer_count;     // Consumers not attached video-only; audio is transcoded only for them
+
+    stream_ingest_streams_t *streams;   // Snapshot for the current connection
+    int generation;
+
+    preroll_buffer_t preroll;     // Recent GOPs handed to consumers attaching with pre-roll
+
+    atomic_int connected;
+    stream_counters_t counters;   // Written only by the ingest thread
+    packet_activity_t activity;   // Motion estimated from packet sizes, written only by the ingest thread
+
+    // Exported counters; ingest FPS and bitrate are their rates
+    metric_t frames_metric;
+    metric_t bytes_metric;
+    metric_t reconnects_metric;
+    metric_t lost_metric;
+    metric_t jitter_metric;
+
+    // Latency of the demux and enqueue pipeline stages
+    metric_t demux_metric;
+    metric_t enqueue_metric;
+    pipeline_clock_t demux_clock;   // Written only by the ingest thread
+} stream_ingest_t;
+
+/**
+ * Hook run before an ingest reconnects to its input
+ *
+ * Lets the owner of an upstream (e.g. go2rtc) hold reconnects back until it
+ * can serve them, instead of every ingest retrying on its own schedule.
+ *
+ * @param url Input URL the ingest is about to open
+ * @param timeout_ms Longest the hook should wait
+ */
+typedef void (*stream_ingest_reconnect_gate_t)(const char *url, int timeout_ms);
+
+/**
+ * Initialize the shared ingest system
+ *
+ * @return 0 on success, non-zero on failure
+ */
+int init_stream_ingest_system(void);
+
+/**
+ * Shut down the shared ingest system
+ * Stops every ingest thread and wakes up all consumers with EOF
+ */
+void shutdown_stream_ingest_system(void);
+
+/**
+ * Check whether shared ingest is enabled in the configuration
+ *
+ * @return true if consumers should attach to the shared ingest
+ */
+bool stream_ingest_enabled(void);
+
+/**
+ * Set the hook run before every reconnect, NULL to remove it
+ *
+ * @param gate Hook
+ */
+void stream_ingest_set_reconnect_gate(stream_ingest_reconnect_gate_t gate);
+
+/**
+ * Attach a consumer to the ingest for a URL, starting the ingest if needed
+ *
+ * Consumers attaching with the same URL share one input connection.
+ *
+ * @param stream_name Name of the stream (for logging and statistics)
+ * @param url Input URL to demux
+ * @param protocol STREAM_PROTOCOL_TCP or STREAM_PROTOCOL_UDP
+ * @param consumer_name Short name of the consumer (e.g. "hls", "mp4")
+ * @param queue_depth Queue depth in packets (<= 0 for [streams] ingest_queue_depth or the device profile)
+ * @param video_only Whether to queue only video packets
+ * @return Consumer handle or NULL on failure
+ */
+stream_ingest_consumer_t *stream_ingest_attach(const char *stream_name, const char *url, int protocol,
+                                               const char *consumer_name, int queue_depth, bool video_only);
+
+/**
+ * Attach a consumer whose queue starts with the ingest's pre-detection buffer
+ *
+ * Same as stream_ingest_attach, but the packets currently held in the
+ * ingest's pre-roll (see stream_ingest_set_preroll) are queued first, followed
+ * seamlessly by live packets.
+ *
+ * @return Consumer handle or NULL on failure
+ */
+stream_ingest_consumer_t *stream_ingest_attach_with_preroll(const char *stream_name, const char *url,
+                                                            int protocol, const char *consumer_name,
+                                                            int queue_depth, bool video_only);
+
+/**
+ * Attach a live consumer whose queue starts with the newest GOP the ingest holds
+ *
+ * Same as stream_ingest_attach, but the consumer gets the packets from the
+ * last key frame onwards right away instead of waiting for the next one. The
+ * ingest holds that GOP when it keeps a pre-roll or the GOP cache
+ * (ingest_gop_cache) is enabled.
+ *
+ * @return Consumer handle or NULL on failure
+ */
+stream_ingest_consumer_t *stream_ingest_attach_with_gop(const char *stream_name, const char *url,
+                                                        int protocol, const char *consumer_name,
+                                                        int queue_depth, bool video_only);
+
+/**
+ * Set how many seconds of packets the ingests of a stream keep for pre-roll
+ *
+ * New ingests take their initial value from the stream's pre_detection_buffer
+ * when detection-based recording is enabled. Does not read the database, so
+ * it can be called for every detection.
+ *
+ * @param stream_name Name of the stream
+ * @param config Configuration of the stream, used to leave out the detection
+ *               sub-stream (may be NULL when disabling the pre-roll)
+ * @param seconds Seconds to keep (0 disables the pre-roll)
+ * @return 0 on success, -1 if no ingest serves the stream
+ */
+int stream_ingest_set_preroll(const char *stream_name, const stream_config_t *config, int seconds);
+
+/**
+ * Detach a consumer and free it
+ * The ingest is stopped when its last consumer detaches.
+ *
+ * @param consumer Consumer handle
+ */
+void stream_ingest_detach(stream_ingest_consumer_t *consumer);
+
+/**
+ * Wait until stream parameters are available for the consumer
+ *
+ * @param consumer Consumer handle
+ * @param timeout_ms Maximum time to wait in milliseconds
+ * @return 0 when streams are available, AVERROR(EAGAIN) on timeout, AVERROR_EOF if stopping
+ */
+int stream_ingest_wait_for_streams(stream_ingest_consumer_t *consumer, int timeout_ms);
+
+/**
+ * Read the next packet for a consumer
+ *
+ * The packet references the ingest's buffer; the caller must av_packet_unref it.
+ *
+ * @param consumer Consumer handle
+ * @param pkt Packet to fill
+ * @param timeout_ms Maximum time to wait in milliseconds
+ * @return 0 on success, AVERROR(EAGAIN) on timeout, AVERROR_EOF if the ingest is
+ *         stopping, or STREAM_INGEST_STREAMS_CHANGED if the input streams changed
+ */
+int stream_ingest_read_packet(stream_ingest_consumer_t *consumer, AVPacket *pkt, int timeout_ms);
+
+/**
+ * Get the shadow format context describing the consumer's current streams
+ *
+ * The context stays valid until the call to stream_ingest_read_packet that
+ * follows one returning STREAM_INGEST_STREAMS_CHANGED. It must not be closed
+ * or freed by the caller.
+ *
+ * @param consumer Consumer handle
+ * @return Format context or NULL if no streams are known yet
+ */
+AVFormatContext *stream_ingest_get_format_context(stream_ingest_consumer_t *consumer);
+
+/**
+ * Get the video stream index of the consumer's current streams
+ *
+ * @param consumer Consumer handle
+ * @return Video stream index or -1 if unknown
+ */
+int stream_ingest_get_video_stream_index(stream_ingest_consumer_t *consumer);
+
+/**
+ * Get the audio stream index of the consumer's current streams
+ *
+ * @param consumer Consumer handle
+ * @return Audio stream index or -1 if none
+ */
+int stream_ingest_get_audio_stream_index(stream_ingest_consumer_t *consumer);
+
+/**
+ * Check whether the packet sizes of the consumer's input showed activity recently
+ *
+ * Costs no decoding (see packet_activity.h). A stream counts as active
+ * while its baseline is still being learnt after (re)connecting.
+ *
+ * @param consumer Consumer handle
+ * @param hold_ms How long activity counts after the last packet that stood out
+ * @return true if active within hold_ms
+ */
+bool stream_ingest_active(stream_ingest_consumer_t *consumer, int hold_ms);
+
+/**
+ * Get statistics for the ingest serving a stream
+ *
+ * @param stream_name Name of the stream
+ * @param stats Statistics to fill
+ * @return 0 on success, -1 if no ingest serves the stream
+ */
+int stream_ingest_get_stats(const char *stream_name, stream_ingest_stats_t *stats);
+
+/**
+ * Add the streams an ingest of a stream delivers to an output context
+ *
+ * Lets a recorder prepare its output before it attaches. The video stream
+ * comes first, then the audio stream if asked for and present, each with
+ * the codec parameters and time base consumers will see. Ingests of the
+ * detection sub-stream are skipped.
+ *
+ * @param stream_name Name of the stream
+ * @param output_ctx Output context to add the streams to
+ * @param with_audio Whether to add the audio stream
+ * @return 0 on success, -1 if no ingest of the stream has streams yet
+ */
+int stream_ingest_add_output_streams(const char *stream_name, AVFormatContext *output_ctx, bool with_audio);
+
+/**
+ * Get statistics for a consumer
+ *
+ * @param consumer Consumer handle
+ * @param stats Statistics to fill
+ * @return 0 on success, -1 on failure
+ */
+int stream_ingest_get_consumer_stats(stream_ingest_consumer_t *consumer, stream_ingest_consumer_stats_t *stats);
+
+#endif /* LIGHTNVR_STREAM_INGEST_H */
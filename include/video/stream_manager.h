@@ -24,6 +24,8 @@ typedef struct {
     uint64_t frames_dropped;
     uint64_t errors;
     uint64_t reconnects;
+    uint64_t packets_lost;   // RTP packets lost on the network (UDP)
+    uint64_t jitter_us;      // Interarrival jitter of video packets (UDP)
     double bitrate;          // in kbps
     double fps;              // actual fps
     uint64_t uptime;         // in seconds
@@ -104,6 +106,26 @@ int get_stream_stats(stream_handle_t handle, stream_stats_t *stats);
  */
 int get_stream_config(stream_handle_t handle, stream_config_t *config);
 
+/**
+ * Get a reference to the current configuration of a stream
+ *
+ * Configurations are kept as immutable, reference-counted snapshots that
+ * are replaced when the streams table changes, so readers take neither a
+ * lock nor a copy. The snapshot stays valid, and unchanged, until it is
+ * released, even if the stream is updated or removed meanwhile.
+ *
+ * @param handle Stream handle
+ * @return Configuration to release with stream_config_release(), or NULL on failure
+ */
+const stream_config_t *stream_config_acquire(stream_handle_t handle);
+
+/**
+ * Release a configuration returned by stream_config_acquire()
+ *
+ * @param config Configuration, NULL is ignored
+ */
+void stream_config_release(const stream_config_t *config);
+
 /**
  * Get stream by index
  * 
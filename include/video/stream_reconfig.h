@@ -0,0 +1,65 @@
+/**
+ * Stream Reconfiguration
+ *
+ * Works out what a change to a stream's settings touches and applies it
+ * with as little disruption as possible:
+ *
+ *   - tuning (detection threshold, interval, sampling, motion gate and
+ *     zones, detection buffers, priority, retention) is applied to the
+ *     running threads in place
+ *   - consumer settings restart only that consumer (detection, MP4
+ *     recording or HLS), the camera connection stays up
+ *   - input settings (URL, protocol, credentials, enabled) restart the
+ *     whole stream
+ */
+
+#ifndef LIGHTNVR_STREAM_RECONFIG_H
+#define LIGHTNVR_STREAM_RECONFIG_H
+
+#include <stddef.h>
+
+#include "core/config.h"
+#include "video/stream_manager.h"
+
+// Parts of a stream affected by a configuration change
+typedef enum {
+    STREAM_CHANGE_NONE = 0,
+    STREAM_CHANGE_LIVE = 1 << 0,        // Applied in place
+    STREAM_CHANGE_DETECTION = 1 << 1,   // Detection thread restarts (detection URL, on/off); a new model is swapped in
+    STREAM_CHANGE_RECORDING = 1 << 2,   // MP4 recording restarts (record, audio, segment length)
+    STREAM_CHANGE_HLS = 1 << 3,         // HLS streaming starts, stops or restarts (segment format)
+    STREAM_CHANGE_INPUT = 1 << 4        // Whole stream restarts (URL, protocol, credentials, enabled)
+} stream_change_t;
+
+/**
+ * Compare two configurations of a stream
+ *
+ * @param old_config Configuration the stream runs with
+ * @param new_config New configuration
+ * @return Bitmask of stream_change_t, STREAM_CHANGE_NONE if nothing changed
+ */
+unsigned int stream_config_changes(const stream_config_t *old_config, const stream_config_t *new_config);
+
+/**
+ * Apply a changed configuration to a stream
+ * The new configuration must already be stored in the database.
+ *
+ * @param stream Stream handle
+ * @param old_config Configuration the stream runs with
+ * @param new_config New configuration
+ * @param changes Result of stream_config_changes()
+ * @return 0 on success, -1 if part of the change could not be applied
+ */
+int apply_stream_config_changes(stream_handle_t stream, const stream_config_t *old_config,
+                                const stream_config_t *new_config, unsigned int changes);
+
+/**
+ * Name the parts of a stream affected by a change, for logs and the API
+ *
+ * @param changes Bitmask of stream_change_t
+ * @param buffer Receives a comma-separated list, "none" if empty
+ * @param size Size of buffer
+ */
+void describe_stream_changes(unsigned int changes, char *buffer, size_t size);
+
+#endif /* LIGHTNVR_STREAM_RECONFIG_H */
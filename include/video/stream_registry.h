@@ -0,0 +1,84 @@
+/**
+ * Stream Registry
+ *
+ * Interns stream names into small integer IDs (0 to capacity - 1) so that
+ * the stream manager, the stream state manager, motion and object detection
+ * can keep their per-stream data in arrays indexed by ID and resolve a name
+ * with one hash lookup instead of a strcmp scan over each of their tables.
+ *
+ * Every subsystem that keeps data indexed by an ID holds a reference on it;
+ * the ID is reused once the last reference is released. Code that only needs
+ * to resolve a name, such as the web API, uses stream_registry_lookup and
+ * verifies the name of the entry it finds.
+ *
+ * The capacity is the max_streams setting, fixed when the registry is first
+ * used; tables indexed by ID are sized with stream_registry_capacity().
+ */
+
+#ifndef LIGHTNVR_STREAM_REGISTRY_H
+#define LIGHTNVR_STREAM_REGISTRY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "core/config.h"
+
+#define STREAM_ID_INVALID (-1)
+
+/**
+ * Size the registry to the configured number of streams
+ * Does nothing if the registry is already initialized. Otherwise the first
+ * call to any other function initializes it from g_config.max_streams.
+ *
+ * @param max_streams Number of IDs (1 to MAX_STREAMS)
+ * @return 0 on success, -1 on allocation failure
+ */
+int stream_registry_init(int max_streams);
+
+/**
+ * Get the number of IDs the registry can hand out
+ *
+ * @return Capacity, or 0 if the registry could not be allocated
+ */
+int stream_registry_capacity(void);
+
+/**
+ * Get the ID of a stream, registering the name if needed, and take a reference
+ *
+ * @param stream_name Name of the stream
+ * @return Stream ID, or STREAM_ID_INVALID if the registry is full
+ */
+int stream_registry_acquire(const char *stream_name);
+
+/**
+ * Drop a reference taken with stream_registry_acquire
+ *
+ * @param stream_id Stream ID
+ */
+void stream_registry_release(int stream_id);
+
+/**
+ * Get the ID of a registered stream without taking a reference
+ *
+ * @param stream_name Name of the stream
+ * @return Stream ID, or STREAM_ID_INVALID if the name is not registered
+ */
+int stream_registry_lookup(const char *stream_name);
+
+/**
+ * Get the name registered for an ID
+ *
+ * @param stream_id Stream ID
+ * @param name Buffer receiving the name
+ * @param name_size Size of the buffer
+ * @return 0 on success, -1 if the ID is not in use
+ */
+int stream_registry_get_name(int stream_id, char *name, size_t name_size);
+
+/**
+ * Get the number of registered streams
+ *
+ * @return Number of IDs in use
+ */
+int stream_registry_count(void);
+
+#endif /* LIGHTNVR_STREAM_REGISTRY_H */
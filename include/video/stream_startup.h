@@ -0,0 +1,96 @@
+/**
+ * Stream Startup
+ *
+ * Brings the configured streams up after boot with a bounded number of
+ * streams starting at once, instead of one after the other. Each worker
+ * starts the services of one stream (HLS, recording, detection) and waits
+ * until its shared ingest has connected to the camera before taking the
+ * next one, so no more than [streams] startup_concurrency cameras are
+ * being connected at the same time.
+ *
+ * The database and go2rtc are up before the workers start; the progress of
+ * each stream is kept for GET /api/system/startup.
+ */
+
+#ifndef LIGHTNVR_STREAM_STARTUP_H
+#define LIGHTNVR_STREAM_STARTUP_H
+
+#include <stdbool.h>
+#include <time.h>
+
+#include "core/config.h"
+
+// Streams started at once, unless configured
+#define STREAM_STARTUP_DEFAULT_CONCURRENCY 4
+#define STREAM_STARTUP_MAX_CONCURRENCY 16
+
+// How long a worker waits for a stream to connect before taking the next one
+#define STREAM_STARTUP_CONNECT_TIMEOUT_MS 30000
+
+typedef enum {
+    STREAM_STARTUP_PENDING = 0,     // Waiting for a worker
+    STREAM_STARTUP_STARTING,        // Services being started
+    STREAM_STARTUP_CONNECTING,      // Services started, camera not connected yet
+    STREAM_STARTUP_READY,           // Receiving packets from the camera
+    STREAM_STARTUP_FAILED           // Services failed to start
+} stream_startup_state_t;
+
+// Startup progress of one stream
+typedef struct {
+    char name[MAX_STREAM_NAME];
+    stream_startup_state_t state;
+    time_t started_at;              // When a worker took the stream, 0 while pending
+    time_t ready_at;                // When it became ready or failed, 0 until then
+} stream_startup_status_t;
+
+/**
+ * Starts the services of a stream
+ *
+ * @param index Index of the stream in the configuration
+ * @return 0 on success, -1 if a service failed to start
+ */
+typedef int (*stream_startup_fn_t)(int index);
+
+/**
+ * Start the enabled streams in the background
+ *
+ * @param streams Configured streams, must stay valid until startup is complete
+ * @param count Number of entries in streams
+ * @param concurrency Streams started at once (1 to STREAM_STARTUP_MAX_CONCURRENCY)
+ * @param start Starts the services of one stream, called from the workers
+ * @return 0 on success, -1 on error
+ */
+int stream_startup_begin(const stream_config_t *streams, int count, int concurrency,
+                         stream_startup_fn_t start);
+
+/**
+ * Stop starting streams and wait for the workers to exit
+ */
+void stream_startup_shutdown(void);
+
+/**
+ * Get the startup progress of all streams
+ *
+ * @param status Receives one entry per enabled stream, in configuration order
+ * @param max_count Capacity of status
+ * @param complete Set to whether every stream has been handled (may be NULL)
+ * @return Number of entries
+ */
+int stream_startup_get_status(stream_startup_status_t *status, int max_count, bool *complete);
+
+/**
+ * Number of streams started at once
+ *
+ * @return Concurrency, 0 before stream_startup_begin()
+ */
+int stream_startup_concurrency(void);
+
+/**
+ * Name of a startup state, for logs and the API
+ *
+ * @param state State
+ * @return Static string
+ */
+const char *stream_startup_state_name(stream_startup_state_t state);
+
+#endif /* LIGHTNVR_STREAM_STARTUP_H */
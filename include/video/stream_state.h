@@ -4,6 +4,7 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <pthread.h>
+#include <stdatomic.h>
 #include <time.h>
 #include "core/config.h"
 #include "video/stream_manager.h"
@@ -44,16 +45,17 @@ typedef struct {
 
 /**
  * Stream timestamp state - for handling timestamps in different protocols
+ * Written only by the packet processing thread, read without the mutex
  */
 typedef struct {
-    int64_t last_pts;            // Last presentation timestamp
-    int64_t last_dts;            // Last decoding timestamp
-    int64_t expected_next_pts;   // Expected next PTS
+    atomic_int_fast64_t last_pts;          // Last presentation timestamp
+    atomic_int_fast64_t last_dts;          // Last decoding timestamp
+    atomic_int_fast64_t expected_next_pts; // Expected next PTS
     int64_t pts_discontinuity_count; // Count of PTS discontinuities
-    bool timestamps_initialized; // Whether timestamps have been initialized
+    atomic_bool timestamps_initialized;    // Whether timestamps have been initialized
 } stream_timestamp_state_t;
 
-// Use stream_stats_t from stream_manager.h
+// Use stream_stats_t from stream_manager.h; the packet counters come from the ingest
 
 /**
  * Stream component type - identifies different components that can reference a stream
@@ -73,11 +75,13 @@ typedef enum {
  */
 typedef struct {
     char name[MAX_STREAM_NAME];  // Stream name
+    int stream_id;               // Registry ID, also the slot in the state array
     stream_state_t state;        // Current operational state
     stream_features_t features;  // Enabled features
     stream_protocol_state_t protocol_state; // Protocol-specific state
     stream_timestamp_state_t timestamp_state; // Timestamp handling state
-    stream_stats_t stats;        // Stream statistics
+    atomic_uint_fast64_t errors;     // Errors handled by handle_stream_error()
+    atomic_uint_fast64_t reconnects; // Reconnections started after an error
     stream_config_t config;      // Stream configuration
     pthread_mutex_t mutex;       // Mutex for thread-safe access
     pthread_mutex_t state_mutex; // Mutex specifically for state transitions
@@ -182,8 +186,23 @@ int stop_stream_with_state(stream_state_manager_t *state, bool wait_for_completi
  */
 stream_state_t get_stream_operational_state(stream_state_manager_t *state);
 
+/**
+ * Note that a stream changed state or status
+ * Called by the stream manager for status changes it tracks itself.
+ */
+void stream_state_changed(void);
+
+/**
+ * Get a counter that increases whenever any stream changes state
+ * Lets API responses showing stream states tell whether they are current.
+ *
+ * @return State version
+ */
+uint64_t get_stream_state_version(void);
+
 /**
  * Get stream statistics
+ * Reads the counters with relaxed loads, without taking the state mutex.
  * 
  * @param state Stream state manager
  * @param stats Pointer to statistics structure to fill
@@ -0,0 +1,87 @@
+/**
+ * Stream pipeline supervisor
+ *
+ * Each supervised pipeline stage of a stream publishes a heartbeat, an
+ * atomic store of the time it last made progress (a packet read, a segment
+ * written). Beating never takes a lock or wakes anything.
+ *
+ * One supervisor thread keeps every stage on a timer wheel at its deadline,
+ * last beat plus timeout, and only wakes when the earliest deadline comes
+ * up. A stage that beat in the meantime is simply moved to its new deadline;
+ * one that did not is restarted through its restart function. Restarts of a
+ * stage back off exponentially while it keeps stalling, and the backoff is
+ * forgotten once it has run cleanly for a while, so a camera that is
+ * offline is retried ever less often instead of being restarted in a loop.
+ *
+ * Stages are kept per stream name and stage, so the backoff survives the
+ * stop and start of a restart.
+ */
+
+#ifndef LIGHTNVR_STREAM_SUPERVISOR_H
+#define LIGHTNVR_STREAM_SUPERVISOR_H
+
+#include <stdbool.h>
+
+typedef struct supervised supervised_t;
+
+/**
+ * Restart a stalled stage
+ * Runs on the supervisor thread without its lock, so it may unregister and
+ * register the stage again.
+ *
+ * @param stream_name Name of the stream
+ * @return 0 if the stage was restarted or will be retried, -1 if it should no
+ *         longer be supervised (the stream was deleted or disabled)
+ */
+typedef int (*supervisor_restart_fn)(const char *stream_name);
+
+/**
+ * Start the supervisor thread
+ *
+ * @return 0 on success, -1 on error
+ */
+int start_stream_supervisor(void);
+
+/**
+ * Stop the supervisor thread; no restart is started after this returns
+ */
+void stop_stream_supervisor(void);
+
+/**
+ * Supervise a stage of a stream
+ * The deadline starts with a full timeout from now. Registering a stage that
+ * is already registered moves it to the new restart function and timeout.
+ *
+ * @param stream_name Name of the stream
+ * @param stage Short name of the stage, e.g. "hls"
+ * @param timeout_ms Longest time without a heartbeat before the stage is restarted
+ * @param restart Restart function, or NULL to only log stalls
+ * @return Stage to beat, or NULL if the table is full
+ */
+supervised_t *supervisor_register(const char *stream_name, const char *stage, int timeout_ms,
+                                  supervisor_restart_fn restart);
+
+/**
+ * Stop supervising a stage, for a deliberate stop
+ * Heartbeats on the stage are ignored until it is registered again.
+ */
+void supervisor_unregister(supervised_t *stage);
+
+/**
+ * Publish a heartbeat of a stage
+ * Cheap enough to call for every packet.
+ */
+void supervisor_beat(supervised_t *stage);
+
+/**
+ * Report a stage as stalled without waiting for its deadline
+ * Used by consumers that see the output of a stage stop, such as missing
+ * HLS segments. The restart still honors the backoff of the stage.
+ *
+ * @param stream_name Name of the stream
+ * @param stage Name of the stage
+ * @return true if the stage is supervised, false if nothing runs to restart
+ */
+bool supervisor_report_stall(const char *stream_name, const char *stage);
+
+#endif /* LIGHTNVR_STREAM_SUPERVISOR_H */
@@ -7,6 +7,26 @@
 #include "video/timestamp_manager.h"
 #include "video/packet_processor.h"
 
+/**
+ * H.264 encoder on the hardware backend selected for decoding
+ *
+ * The encoder matching [hardware] hw_accel_device is used when the FFmpeg
+ * build has it and it opens: h264_vaapi, h264_nvenc, h264_qsv, h264_rkmpp
+ * or h264_v4l2m2m. Otherwise libx264, or whatever H.264 encoder FFmpeg has,
+ * encodes in software; at most [hardware] transcode_max_software of those
+ * run at once.
+ */
+typedef struct {
+    AVCodecContext *codec_ctx;
+    enum AVPixelFormat sw_format;   // Format of the frames to pass in
+    AVFrame *hw_frame;              // Upload surface, for encoders that take hardware frames
+    bool hardware;
+    bool software_slot;             // Holds one of the software encoder slots
+} transcode_encoder_t;
+
+// All software encoder slots are taken
+#define TRANSCODE_ENCODER_BUSY (-2)
+
 /**
  * Initialize transcoding backend
  * Sets up FFmpeg and timestamp trackers
@@ -15,8 +35,49 @@ void init_transcoding_backend(void);
 
 /**
  * Cleanup transcoding backend
- * Cleans up FFmpeg and timestamp trackers
+ * Cleans up FFmpeg, timestamp trackers and the hardware decoding device
  */
 void cleanup_transcoding_backend(void);
 
+/**
+ * Open an H.264 encoder, in hardware when possible
+ *
+ * @param encoder Encoder to open
+ * @param width Width of the frames
+ * @param height Height of the frames
+ * @param time_base Time base of the frame timestamps
+ * @param frame_rate Nominal frame rate, for rate control
+ * @param bit_rate Target bit rate in bits per second
+ * @param gop_size Frames between key frames
+ * @param global_header Put the parameter sets in extradata, for MP4 output
+ * @return 0 on success, TRANSCODE_ENCODER_BUSY if only a software encoder is
+ *         available and all its slots are taken, -1 on error
+ */
+int transcode_encoder_open(transcode_encoder_t *encoder, int width, int height, AVRational time_base,
+                           AVRational frame_rate, int64_t bit_rate, int gop_size, bool global_header);
+
+/**
+ * Send a frame to an encoder
+ *
+ * @param encoder Encoder
+ * @param frame Frame in the encoder's sw_format and size, NULL to flush
+ * @return 0 on success, negative AVERROR on error
+ */
+int transcode_encoder_send_frame(transcode_encoder_t *encoder, const AVFrame *frame);
+
+/**
+ * Close an encoder
+ *
+ * @param encoder Encoder, may be unopened
+ */
+void transcode_encoder_close(transcode_encoder_t *encoder);
+
+/**
+ * Get the bit rate to encode a picture height at
+ *
+ * @param height Height of the pictures
+ * @return Bit rate in bits per second
+ */
+int64_t transcode_bit_rate(int height);
+
 #endif /* STREAM_TRANSCODING_H */
@@ -80,9 +80,6 @@ int get_recording_state(const char *stream_name);
 int start_detection_recording(const char *stream_name, const char *model_path, float threshold,
                              int pre_buffer, int post_buffer);
 int stop_detection_recording(const char *stream_name);
-int process_frame_for_recording(const char *stream_name, const unsigned char *frame_data,
-                               int width, int height, int channels, time_t frame_time,
-                               detection_result_t *result);
 int get_detection_recording_state(const char *stream_name, bool *recording_active);
 void init_detection_recording_system(void);
 void shutdown_detection_recording_system(void);
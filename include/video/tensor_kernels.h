@@ -0,0 +1,58 @@
+/**
+ * Model Input Kernels
+ *
+ * Fused conversion of decoded YUV 4:2:0 frames into the planar float RGB
+ * tensors CNN models take: resize, colorspace conversion and normalization
+ * in one pass, with AVX2 and NEON implementations picked once at runtime
+ * from the CPU features. Every vector implementation gives exactly the same
+ * output as the scalar reference, so detection results do not depend on the
+ * machine.
+ */
+
+#ifndef LIGHTNVR_TENSOR_KERNELS_H
+#define LIGHTNVR_TENSOR_KERNELS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Widest tensor the kernels produce; the column tables live on the stack
+#define TENSOR_MAX_WIDTH 2048
+
+/**
+ * YUV 4:2:0 image, planar (YUV420P) or with interleaved chroma (NV12)
+ */
+typedef struct {
+    const uint8_t *y;      // Luma plane
+    const uint8_t *u;      // First Cb sample
+    const uint8_t *v;      // First Cr sample
+    int y_stride;          // Bytes between luma rows
+    int uv_stride;         // Bytes between chroma rows
+    int uv_step;           // Bytes between chroma samples of a row: 1 planar, 2 interleaved
+    int width;             // Luma width
+    int height;            // Luma height
+    bool full_range;       // JPEG levels (0-255) instead of video levels (16-235)
+} yuv420_image_t;
+
+/**
+ * Name of the instruction set the kernels use on this CPU
+ *
+ * @return "avx2", "neon" or "scalar"
+ */
+const char *tensor_kernels_isa(void);
+
+/**
+ * Resize a YUV 4:2:0 image and convert it to planar RGB floats in 0-1
+ * Luma is sampled bilinearly with the corners aligned, like SOD's own
+ * resize, chroma from the nearest sample, and the color conversion uses
+ * 8-bit fixed-point BT.601 coefficients. The R, G and B planes of
+ * dst_width x dst_height floats follow each other in dst.
+ *
+ * @param src Source image
+ * @param dst Destination, 3 * dst_width * dst_height floats
+ * @param dst_width Tensor width (at most TENSOR_MAX_WIDTH)
+ * @param dst_height Tensor height
+ * @return 0 on success, -1 on invalid sizes
+ */
+int tensor_from_yuv420(const yuv420_image_t *src, float *dst, int dst_width, int dst_height);
+
+#endif /* LIGHTNVR_TENSOR_KERNELS_H */
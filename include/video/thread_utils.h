@@ -2,8 +2,77 @@
 #define THREAD_UTILS_H
 
 #include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "core/config.h"
+
+// Stack size for the per-stream threads (ingest, HLS writer, MP4 writer).
+// glibc reserves 8 MB per thread by default, which adds up to several hundred
+// MB of address space with 16 cameras on a 32-bit device, while musl's 128 KB
+// default is tighter than FFmpeg is comfortable with.
+#define STREAM_THREAD_STACK_SIZE (512 * 1024)
+
+// Detection threads also run model inference on their stack
+#define DETECTION_THREAD_STACK_SIZE (1024 * 1024)
 
 // Join a thread with timeout
 int pthread_join_with_timeout(pthread_t thread, void **retval, int timeout_sec);
 
+/**
+ * Create a thread with an explicit stack size
+ * Falls back to the default stack size if the requested one is rejected.
+ *
+ * @param thread Receives the thread handle
+ * @param start_routine Thread function
+ * @param arg Argument passed to the thread function
+ * @param stack_size Stack size in bytes (0 for the default)
+ * @param detached Whether the thread is created detached
+ * @return 0 on success, error number on failure (as pthread_create)
+ */
+int pthread_create_with_stack(pthread_t *thread, void *(*start_routine)(void *), void *arg,
+                              size_t stack_size, bool detached);
+
+// Longest thread name Linux keeps, without the terminating NUL
+#define THREAD_NAME_MAX 15
+
+// CPU time of one thread of the process
+typedef struct {
+    int tid;
+    char name[THREAD_NAME_MAX + 1];
+    double user_seconds;
+    double system_seconds;
+    double cpu_percent;         // Of one CPU since the previous call, -1 for threads not seen before
+    int nice;
+    int last_cpu;               // CPU the thread last ran on
+} thread_cpu_usage_t;
+
+/**
+ * Set the scheduling applied to each thread class
+ * Threads pick the settings up when they call thread_set_identity().
+ *
+ * @param sched THREAD_CLASS_COUNT entries, usually config_t.thread_sched
+ */
+void thread_utils_configure(const thread_sched_config_t *sched);
+
+/**
+ * Name the calling thread and apply the scheduling of its class
+ * The name is "<role>:<detail>", or just the role, cut to THREAD_NAME_MAX
+ * characters, and shows up in top -H, ps and /api/system/threads.
+ *
+ * @param thread_class Class whose CPU affinity, nice value and policy to apply
+ * @param role Short name of what the thread does, e.g. "hls"
+ * @param detail Stream name or index (may be NULL)
+ */
+void thread_set_identity(thread_class_t thread_class, const char *role, const char *detail);
+
+/**
+ * Get the CPU time of the threads of the process from /proc/self/task
+ *
+ * @param threads Receives one entry per thread, busiest first
+ * @param max_count Capacity of threads
+ * @return Number of entries, -1 on error
+ */
+int thread_get_cpu_usage(thread_cpu_usage_t *threads, int max_count);
+
 #endif // THREAD_UTILS_H
@@ -10,14 +10,21 @@
 
 // Use MAX_STREAM_NAME from config.h (256)
 
+// Per-stream timestamp tracker
+// Trackers live in a static table, so hot paths can look theirs up once at
+// stream start and use the timestamp_tracker_* functions instead of the
+// name-based ones. A tracker stays valid until remove_timestamp_tracker or
+// cleanup_timestamp_trackers is called for its stream.
+typedef struct timestamp_tracker timestamp_tracker_t;
+
 // Initialize timestamp trackers
 void init_timestamp_trackers(void);
 
 // Set the UDP flag for a stream's timestamp tracker
 void set_timestamp_tracker_udp_flag(const char *stream_name, bool is_udp);
 
-// Get timestamp tracker for a stream (exposed for packet processor)
-void *get_timestamp_tracker(const char *stream_name);
+// Get or create the timestamp tracker for a stream (NULL if no slot is free)
+timestamp_tracker_t *get_timestamp_tracker(const char *stream_name);
 
 // Reset timestamp tracker for a specific stream
 void reset_timestamp_tracker(const char *stream_name);
@@ -45,4 +52,12 @@ time_t get_last_detection_time(const char *stream_name);
 // This should be called when a detection is performed
 void update_last_detection_time(const char *stream_name, time_t detection_time);
 
+// Tracker versions of the functions above, for per-packet and per-frame paths
+// All of them accept a NULL tracker
+void timestamp_tracker_set_udp_flag(timestamp_tracker_t *tracker, bool is_udp);
+void timestamp_tracker_update_keyframe_time(timestamp_tracker_t *tracker);
+int timestamp_tracker_keyframe_received(timestamp_tracker_t *tracker, time_t *keyframe_time);
+time_t timestamp_tracker_get_last_detection_time(timestamp_tracker_t *tracker);
+void timestamp_tracker_update_last_detection_time(timestamp_tracker_t *tracker, time_t detection_time);
+
 #endif // TIMESTAMP_MANAGER_H
@@ -189,6 +189,87 @@ void mg_handle_hls_media_playlist(struct mg_connection *c, struct mg_http_messag
  */
 void mg_handle_hls_segment(struct mg_connection *c, struct mg_http_message *hm);
 
+/**
+ * @brief Serve a live HLS segment of a stream from the segment index
+ *
+ * Segments kept in memory are sent from memory, others from the path recorded
+ * by the HLS writer. Answers 404 for segments that are not indexed.
+ *
+ * @param c Mongoose connection
+ * @param hm Mongoose HTTP message
+ * @param stream_name Decoded name of the stream
+ * @param file_name File name of the segment
+ * @return true if the request was answered, false if the request is not for a
+ *         segment of a stream with an active segment index
+ */
+bool mg_serve_indexed_hls_segment(struct mg_connection *c, struct mg_http_message *hm,
+                                  const char *stream_name, const char *file_name);
+
+/**
+ * @brief Serve the master playlist and the transcoded renditions of a stream
+ *
+ * Answers master.m3u8 with the stream's variants, and <height>p/<file> from
+ * the rendition's directory. A request for a rendition starts its transcoding;
+ * its playlist is answered with 503 until the first segment is written.
+ *
+ * @param c Mongoose connection
+ * @param hm Mongoose HTTP message
+ * @param stream_name Decoded name of the stream
+ * @param file_name Requested file name
+ * @return true if the request was answered, false if it is not for the master
+ *         playlist or a rendition
+ */
+bool mg_handle_abr_hls_request(struct mg_connection *c, struct mg_http_message *hm,
+                               const char *stream_name, const char *file_name);
+
+/**
+ * @brief Serve the playlist and segments of the mosaic stream
+ *
+ * A request for the mosaic starts it; its playlist is answered with 503 until
+ * the first segment is written.
+ *
+ * @param c Mongoose connection
+ * @param hm Mongoose HTTP message
+ * @param stream_name Decoded name of the stream
+ * @param file_name Requested file name
+ * @return true if the request was answered, false if the stream is not the mosaic
+ */
+bool mg_handle_mosaic_hls_request(struct mg_connection *c, struct mg_http_message *hm,
+                                  const char *stream_name, const char *file_name);
+
+/**
+ * @brief Serve the Low-Latency HLS playlist and parts of a stream
+ *
+ * Blocking playlist reloads (_HLS_msn/_HLS_part) and preload hint requests
+ * for the next part are held on the connection and answered from
+ * mg_poll_ll_hls_request once the part is published or the request times out.
+ *
+ * @param c Mongoose connection
+ * @param hm Mongoose HTTP message
+ * @param stream_name Decoded name of the stream
+ * @param file_name Requested file name
+ * @return true if the request was answered or held, false if the stream has
+ *         no Low-Latency HLS packager or the file is a regular HLS file
+ */
+bool mg_handle_ll_hls_request(struct mg_connection *c, struct mg_http_message *hm,
+                              const char *stream_name, const char *file_name);
+
+/**
+ * @brief Answer the held Low-Latency HLS request of a connection if it is ready
+ *
+ * Called from the event loop for connections marked with 'L' in c->data[0].
+ *
+ * @param c Mongoose connection
+ */
+void mg_poll_ll_hls_request(struct mg_connection *c);
+
+/**
+ * @brief Drop the held Low-Latency HLS request of a closing connection
+ *
+ * @param c Mongoose connection
+ */
+void mg_cancel_ll_hls_request(struct mg_connection *c);
+
 /**
  * @brief Direct handler for GET /api/detection/results/:stream
  * 
@@ -197,6 +278,22 @@ void mg_handle_hls_segment(struct mg_connection *c, struct mg_http_message *hm);
  */
 void mg_handle_get_detection_results(struct mg_connection *c, struct mg_http_message *hm);
 
+/**
+ * @brief Direct handler for POST /api/detection/results/:stream
+ * 
+ * @param c Mongoose connection
+ * @param hm Mongoose HTTP message
+ */
+void mg_handle_post_detection_results(struct mg_connection *c, struct mg_http_message *hm);
+
+/**
+ * @brief Direct handler for GET /api/detection/search
+ * 
+ * @param c Mongoose connection
+ * @param hm Mongoose HTTP message
+ */
+void mg_handle_get_detection_search(struct mg_connection *c, struct mg_http_message *hm);
+
 /**
  * @brief Direct handler for GET /api/detection/models
  * 
@@ -205,6 +302,30 @@ void mg_handle_get_detection_results(struct mg_connection *c, struct mg_http_mes
  */
 void mg_handle_get_detection_models(struct mg_connection *c, struct mg_http_message *hm);
 
+/**
+ * @brief Direct handler for GET /api/detection/replay
+ * 
+ * @param c Mongoose connection
+ * @param hm Mongoose HTTP message
+ */
+void mg_handle_get_detection_replay(struct mg_connection *c, struct mg_http_message *hm);
+
+/**
+ * @brief Direct handler for POST /api/detection/replay
+ * 
+ * @param c Mongoose connection
+ * @param hm Mongoose HTTP message
+ */
+void mg_handle_post_detection_replay(struct mg_connection *c, struct mg_http_message *hm);
+
+/**
+ * @brief Direct handler for DELETE /api/detection/replay
+ * 
+ * @param c Mongoose connection
+ * @param hm Mongoose HTTP message
+ */
+void mg_handle_delete_detection_replay(struct mg_connection *c, struct mg_http_message *hm);
+
 /**
  * @brief Direct handler for POST /api/system/logs/clear
  * 
@@ -229,6 +350,70 @@ void mg_handle_post_system_backup(struct mg_connection *c, struct mg_http_messag
  */
 void mg_handle_get_system_status(struct mg_connection *c, struct mg_http_message *hm);
 
+/**
+ * @brief Direct handler for GET /api/system/load-shedding
+ * 
+ * @param c Mongoose connection
+ * @param hm Mongoose HTTP message
+ */
+void mg_handle_get_load_shedding(struct mg_connection *c, struct mg_http_message *hm);
+
+/**
+ * @brief Direct handler for GET /api/system/device-profile
+ * 
+ * @param c Mongoose connection
+ * @param hm Mongoose HTTP message
+ */
+void mg_handle_get_device_profile(struct mg_connection *c, struct mg_http_message *hm);
+
+/**
+ * @brief Direct handler for GET /api/system/startup
+ * 
+ * @param c Mongoose connection
+ * @param hm Mongoose HTTP message
+ */
+void mg_handle_get_stream_startup(struct mg_connection *c, struct mg_http_message *hm);
+
+/**
+ * @brief Direct handler for GET /api/system/database/integrity
+ * 
+ * @param c Mongoose connection
+ * @param hm Mongoose HTTP message
+ */
+void mg_handle_get_database_integrity(struct mg_connection *c, struct mg_http_message *hm);
+
+/**
+ * @brief Direct handler for POST /api/system/database/backup
+ * 
+ * @param c Mongoose connection
+ * @param hm Mongoose HTTP message
+ */
+void mg_handle_post_database_backup(struct mg_connection *c, struct mg_http_message *hm);
+
+/**
+ * @brief Direct handler for GET /api/system/database/backup
+ * 
+ * @param c Mongoose connection
+ * @param hm Mongoose HTTP message
+ */
+void mg_handle_get_database_backup(struct mg_connection *c, struct mg_http_message *hm);
+
+/**
+ * @brief Direct handler for GET /api/system/memory
+ * 
+ * @param c Mongoose connection
+ * @param hm Mongoose HTTP message
+ */
+void mg_handle_get_memory_usage(struct mg_connection *c, struct mg_http_message *hm);
+
+/**
+ * @brief Direct handler for GET /api/system/threads
+ * 
+ * @param c Mongoose connection
+ * @param hm Mongoose HTTP message
+ */
+void mg_handle_get_thread_usage(struct mg_connection *c, struct mg_http_message *hm);
+
 /**
  * @brief Direct handler for POST /api/streaming/:stream/webrtc/offer
  * 
@@ -0,0 +1,41 @@
+/**
+ * @file api_handlers_backup_ws.h
+ * @brief Database backup progress over WebSocket
+ *
+ * The background backup reports its progress to the "system/backup" topic,
+ * so a client started a backup with POST /api/system/database/backup can
+ * follow it without polling.
+ */
+
+#ifndef API_HANDLERS_BACKUP_WS_H
+#define API_HANDLERS_BACKUP_WS_H
+
+#include "database/db_backup.h"
+
+// Topic of database backup progress
+#define BACKUP_TOPIC "system/backup"
+
+/**
+ * @brief WebSocket handler for the backup topic
+ *
+ * Handles subscribe and unsubscribe messages, and answers a subscribe with
+ * the current status.
+ *
+ * @param client_id WebSocket client ID
+ * @param message WebSocket message
+ */
+void websocket_handle_backup(const char *client_id, const char *message);
+
+/**
+ * @brief Publish the status of the background backup to its subscribers
+ *
+ * Registered with set_backup_progress_callback(), sends:
+ * {"type":"progress","topic":"system/backup",
+ *  "payload":{"state":...,"pages_done":...,"pages_total":...,"compressed":...,
+ *             "size":...,"message":...}}
+ *
+ * @param status Status of the backup
+ */
+void publish_backup_progress(const db_backup_status_t *status);
+
+#endif /* API_HANDLERS_BACKUP_WS_H */
@@ -0,0 +1,54 @@
+/**
+ * @file api_handlers_detection_ws.h
+ * @brief Live detection results over WebSocket
+ *
+ * Every result the detection threads publish on the event bus goes to the
+ * "detections/<stream>" topic, so live overlays are pushed instead of
+ * polled from the database.
+ * The database keeps serving the detection history.
+ */
+
+#ifndef API_HANDLERS_DETECTION_WS_H
+#define API_HANDLERS_DETECTION_WS_H
+
+#include <stdint.h>
+
+#include "video/detection_result.h"
+
+// Topic prefix for live detections, followed by the stream name
+#define DETECTIONS_TOPIC_PREFIX "detections/"
+
+/**
+ * @brief WebSocket handler for the detections topics
+ *
+ * Handles subscribe and unsubscribe messages for "detections/<stream>".
+ *
+ * @param client_id WebSocket client ID
+ * @param message WebSocket message
+ */
+void websocket_handle_detections(const char *client_id, const char *message);
+
+/**
+ * @brief Publish the detections of one frame to the stream's subscribers
+ *
+ * Sends a terse message, so a frame with nothing above the threshold is
+ * published too and clears the overlay:
+ * {"type":"detections","topic":"detections/<stream>",
+ *  "payload":{"ts":<ms>,"pts":<pts>,"d":[[label,confidence,x,y,w,h,track],...]}}
+ *
+ * @param stream_name Stream name
+ * @param result Detections of the frame
+ * @param threshold Minimum confidence of a detection to publish
+ * @param pts Presentation timestamp of the frame in the stream's time base, or -1
+ */
+void publish_live_detections(const char *stream_name, const detection_result_t *result,
+                             float threshold, int64_t pts);
+
+/**
+ * @brief Subscribe to detection events, publishing each with publish_live_detections
+ *
+ * @return 0 on success, -1 on error
+ */
+int start_live_detections(void);
+
+#endif /* API_HANDLERS_DETECTION_WS_H */
@@ -0,0 +1,62 @@
+/**
+ * @file api_handlers_export.h
+ * @brief Streaming export of recorded clips
+ */
+
+#ifndef API_HANDLERS_EXPORT_H
+#define API_HANDLERS_EXPORT_H
+
+#include <stdbool.h>
+
+#include "mongoose.h"
+#include "database/db_recordings.h"
+
+// Marks connections with an export in progress in c->data[0]
+#define MG_EXPORT_MARK 'X'
+
+/**
+ * @brief Handler for GET /api/export
+ *
+ * Exports a time range of one stream as a single MP4, or of several
+ * streams as a ZIP archive with one MP4 each (see video/clip_export.h).
+ * The export is muxed on its own thread while the response is sent with
+ * chunked transfer encoding, through a bounded buffer, so nothing is
+ * staged on disk or held in memory as a whole. Must run on the event loop.
+ *
+ * @param c Mongoose connection
+ * @param hm Mongoose HTTP message
+ */
+void mg_handle_export_clip(struct mg_connection *c, struct mg_http_message *hm);
+
+/**
+ * @brief Send a recording compacted into a shared file as its own MP4
+ *
+ * The recording is copied out of its container as an export is (see
+ * database/db_compaction.h), so it is sent with chunked transfer encoding
+ * and without ranges. Must run on the event loop.
+ *
+ * @param c Mongoose connection
+ * @param recording Recording, with its located file
+ * @param attachment Whether to send it as a download
+ */
+void mg_stream_compacted_recording(struct mg_connection *c, const recording_metadata_t *recording,
+                                   bool attachment);
+
+/**
+ * @brief Send what the export of a connection has produced so far
+ *
+ * Called from the event loop for connections marked with MG_EXPORT_MARK
+ * in c->data[0].
+ *
+ * @param c Mongoose connection
+ */
+void mg_poll_export(struct mg_connection *c);
+
+/**
+ * @brief Stop the export of a closing connection
+ *
+ * @param c Mongoose connection
+ */
+void mg_cancel_export(struct mg_connection *c);
+
+#endif /* API_HANDLERS_EXPORT_H */
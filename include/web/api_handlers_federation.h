@@ -0,0 +1,87 @@
+/**
+ * @file api_handlers_federation.h
+ * @brief API handlers answering for several lightNVR nodes at once
+ *
+ * With federation enabled, a node answers the /api/federation routes with the
+ * results of itself and of the peers in its configuration. Peers are asked
+ * in parallel, each within the peer timeout, and their responses are kept
+ * for a few seconds so a wall of clients polling the same view does not
+ * multiply the requests to every building. Results are merged in the order
+ * the single-node API returns them, and each item names the node it is
+ * from. Live and playback requests are redirected to the node owning the
+ * stream, so media never passes through the aggregating node.
+ */
+
+#ifndef API_HANDLERS_FEDERATION_H
+#define API_HANDLERS_FEDERATION_H
+
+#include "mongoose.h"
+
+// Most nodes of a federation, this node included
+#define FEDERATION_MAX_NODES 16
+
+/**
+ * @brief Handler for GET /api/federation/nodes
+ *
+ * Lists the nodes with whether they answered /api/health in time.
+ *
+ * @param c Mongoose connection
+ * @param hm Mongoose HTTP message
+ */
+void mg_handle_get_federation_nodes(struct mg_connection *c, struct mg_http_message *hm);
+
+/**
+ * @brief Handler for GET /api/federation/streams
+ *
+ * The streams of all nodes, with their status, as /api/streams returns them.
+ *
+ * @param c Mongoose connection
+ * @param hm Mongoose HTTP message
+ */
+void mg_handle_get_federation_streams(struct mg_connection *c, struct mg_http_message *hm);
+
+/**
+ * @brief Handler for GET /api/federation/recordings
+ *
+ * Takes the parameters of /api/recordings and merges the pages of all nodes.
+ * The cursor continues every node where the previous page left it.
+ *
+ * @param c Mongoose connection
+ * @param hm Mongoose HTTP message
+ */
+void mg_handle_get_federation_recordings(struct mg_connection *c, struct mg_http_message *hm);
+
+/**
+ * @brief Handler for GET /api/federation/detection/search
+ *
+ * Takes the parameters of /api/detection/search and merges the pages of all
+ * nodes, newest first.
+ *
+ * @param c Mongoose connection
+ * @param hm Mongoose HTTP message
+ */
+void mg_handle_get_federation_detection_search(struct mg_connection *c, struct mg_http_message *hm);
+
+/**
+ * @brief Handler for GET /api/federation/timeline/segments
+ *
+ * Takes the parameters of /api/timeline/segments and merges the segments of
+ * the stream on all nodes that have it.
+ *
+ * @param c Mongoose connection
+ * @param hm Mongoose HTTP message
+ */
+void mg_handle_get_federation_timeline_segments(struct mg_connection *c, struct mg_http_message *hm);
+
+/**
+ * @brief Handler for /api/federation/node/{node}/{path}
+ *
+ * Redirects to {path} on the node, keeping the query and, with a 307, the
+ * method and body. Used for live streams, playback and snapshots.
+ *
+ * @param c Mongoose connection
+ * @param hm Mongoose HTTP message
+ */
+void mg_handle_federation_node_redirect(struct mg_connection *c, struct mg_http_message *hm);
+
+#endif /* API_HANDLERS_FEDERATION_H */
@@ -0,0 +1,57 @@
+/**
+ * @file api_handlers_metrics.h
+ * @brief Prometheus metrics, pipeline trace and profiler endpoints
+ */
+
+#ifndef API_HANDLERS_METRICS_H
+#define API_HANDLERS_METRICS_H
+
+#include "mongoose.h"
+
+/**
+ * @brief Direct handler for GET /metrics
+ *
+ * Serves the pipeline counters and latency histograms in the Prometheus
+ * text exposition format.
+ *
+ * @param c Mongoose connection
+ * @param hm Mongoose HTTP message
+ */
+void mg_handle_get_metrics(struct mg_connection *c, struct mg_http_message *hm);
+
+/**
+ * @brief Direct handler for POST /api/system/trace
+ *
+ * Starts a pipeline trace capture window. The optional JSON body sets its
+ * length in seconds ("seconds", default 10) and the sampling ("every", every
+ * Nth video frame, default 1).
+ *
+ * @param c Mongoose connection
+ * @param hm Mongoose HTTP message
+ */
+void mg_handle_post_pipeline_trace(struct mg_connection *c, struct mg_http_message *hm);
+
+/**
+ * @brief Direct handler for GET /api/system/trace
+ *
+ * Serves the events of the last capture window as Chrome trace-event JSON,
+ * to load into chrome://tracing or Perfetto.
+ *
+ * @param c Mongoose connection
+ * @param hm Mongoose HTTP message
+ */
+void mg_handle_get_pipeline_trace(struct mg_connection *c, struct mg_http_message *hm);
+
+/**
+ * @brief Direct handler for GET /api/system/profile
+ *
+ * Profiles the process for ?seconds= (default 30) at ?hz= samples per CPU
+ * second (default 99) and serves the folded stacks, one root per thread name.
+ * Answers 501 when the profiler is not built in.
+ *
+ * @param c Mongoose connection
+ * @param hm Mongoose HTTP message
+ */
+void mg_handle_get_profile(struct mg_connection *c, struct mg_http_message *hm);
+
+#endif /* API_HANDLERS_METRICS_H */
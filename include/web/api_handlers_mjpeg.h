@@ -0,0 +1,44 @@
+/**
+ * @file api_handlers_mjpeg.h
+ * @brief Live MJPEG stream endpoint
+ */
+
+#ifndef API_HANDLERS_MJPEG_H
+#define API_HANDLERS_MJPEG_H
+
+#include "mongoose.h"
+
+// Marks connections receiving a live MJPEG stream in c->data[0]
+#define MG_MJPEG_MARK 'J'
+
+/**
+ * @brief Handler for GET /api/streams/:name/mjpeg
+ *
+ * Sends the stream as multipart/x-mixed-replace JPEG frames from the
+ * shared broadcast (see video/mjpeg_broadcast.h) until the client goes
+ * away. Must run on the event loop.
+ *
+ * @param c Mongoose connection
+ * @param hm Mongoose HTTP message
+ */
+void mg_handle_get_stream_mjpeg(struct mg_connection *c, struct mg_http_message *hm);
+
+/**
+ * @brief Send the newest frame to a live MJPEG connection
+ *
+ * Called from the event loop for connections marked with MG_MJPEG_MARK
+ * in c->data[0]. A connection still sending an earlier frame skips the
+ * new one.
+ *
+ * @param c Mongoose connection
+ */
+void mg_poll_mjpeg(struct mg_connection *c);
+
+/**
+ * @brief Remove a closing connection from its broadcast
+ *
+ * @param c Mongoose connection
+ */
+void mg_cancel_mjpeg(struct mg_connection *c);
+
+#endif /* API_HANDLERS_MJPEG_H */
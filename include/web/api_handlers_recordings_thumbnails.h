@@ -0,0 +1,33 @@
+/**
+ * @file api_handlers_recordings_thumbnails.h
+ * @brief Recording thumbnail and scrub sprite endpoints
+ */
+
+#ifndef API_HANDLERS_RECORDINGS_THUMBNAILS_H
+#define API_HANDLERS_RECORDINGS_THUMBNAILS_H
+
+#include "mongoose.h"
+
+/**
+ * @brief Direct handler for GET /api/recordings/thumbnail/:id
+ *
+ * Serves the thumbnail of a finished recording. A missing thumbnail is
+ * queued for generation and answered with 404.
+ *
+ * @param c Mongoose connection
+ * @param hm Mongoose HTTP message
+ */
+void mg_handle_get_recording_thumbnail(struct mg_connection *c, struct mg_http_message *hm);
+
+/**
+ * @brief Direct handler for GET /api/recordings/sprite/:id.vtt and :id.jpg
+ *
+ * Serves the WebVTT index of a recording's scrub sprite and the sprite
+ * sheet it refers to.
+ *
+ * @param c Mongoose connection
+ * @param hm Mongoose HTTP message
+ */
+void mg_handle_get_recording_sprite(struct mg_connection *c, struct mg_http_message *hm);
+
+#endif /* API_HANDLERS_RECORDINGS_THUMBNAILS_H */
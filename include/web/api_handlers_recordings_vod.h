@@ -0,0 +1,24 @@
+/**
+ * @file api_handlers_recordings_vod.h
+ * @brief HLS video on demand playback of recordings
+ */
+
+#ifndef API_HANDLERS_RECORDINGS_VOD_H
+#define API_HANDLERS_RECORDINGS_VOD_H
+
+#include "mongoose.h"
+
+/**
+ * @brief Handler for GET /api/recordings/vod/:id/:file
+ *
+ * Serves the HLS playlist of a recording (index.m3u8) and, for recordings
+ * that are remuxed, its initialization section and segments. With
+ * ?codec=h264, the playlist of an HEVC recording lists H.264 segments
+ * transcoded on request; 503 is returned while no encoder is free.
+ *
+ * @param c Mongoose connection
+ * @param hm Mongoose HTTP message
+ */
+void mg_handle_get_recording_vod(struct mg_connection *c, struct mg_http_message *hm);
+
+#endif /* API_HANDLERS_RECORDINGS_VOD_H */
@@ -0,0 +1,23 @@
+/**
+ * @file api_handlers_snapshot.h
+ * @brief Stream snapshot endpoint
+ */
+
+#ifndef API_HANDLERS_SNAPSHOT_H
+#define API_HANDLERS_SNAPSHOT_H
+
+#include "mongoose.h"
+
+/**
+ * @brief Handler for GET /api/streams/:name/snapshot.jpg
+ *
+ * Serves the newest frame of a stream as JPEG from the snapshot cache.
+ * Optional query parameters: width (scaled down only, keeping the aspect
+ * ratio) and quality (1-100).
+ *
+ * @param c Mongoose connection
+ * @param hm Mongoose HTTP message
+ */
+void mg_handle_get_stream_snapshot(struct mg_connection *c, struct mg_http_message *hm);
+
+#endif /* API_HANDLERS_SNAPSHOT_H */
@@ -0,0 +1,49 @@
+/**
+ * @file api_handlers_streams_ws.h
+ * @brief Stream status over WebSocket
+ *
+ * A thread samples the status of every stream from the stream manager and
+ * the lock-free ingest counters, once a second and whenever a stream changes
+ * state, and publishes the streams that changed to the "streams/status"
+ * topic. Clients get every change as it happens instead of polling each
+ * stream, and the streams are walked once for all of them.
+ */
+
+#ifndef API_HANDLERS_STREAMS_WS_H
+#define API_HANDLERS_STREAMS_WS_H
+
+// Topic of stream status changes
+#define STREAMS_STATUS_TOPIC "streams/status"
+
+/**
+ * @brief WebSocket handler for the stream status topic
+ *
+ * Handles subscribe and unsubscribe messages, and answers a subscribe with
+ * the status of all streams:
+ * {"type":"ack","topic":"streams/status","payload":{"streams":[...]}}
+ *
+ * @param client_id WebSocket client ID
+ * @param message WebSocket message
+ */
+void websocket_handle_stream_status(const char *client_id, const char *message);
+
+/**
+ * @brief Start the thread publishing stream status changes
+ *
+ * Changes are published as
+ * {"type":"delta","topic":"streams/status",
+ *  "payload":{"streams":[{"name":...,"state":...,"enabled":...,"connected":...,
+ *             "recording":...,"fps":...,"bitrate":...,"errors":...,
+ *             "reconnects":...,"last_packet":...}],"removed":[names]}}
+ * with only the streams that changed.
+ *
+ * @return 0 on success, -1 on error
+ */
+int stream_status_publisher_start(void);
+
+/**
+ * @brief Stop the thread publishing stream status changes
+ */
+void stream_status_publisher_stop(void);
+
+#endif /* API_HANDLERS_STREAMS_WS_H */
@@ -6,7 +6,10 @@
 #ifndef API_HANDLERS_SYSTEM_WS_H
 #define API_HANDLERS_SYSTEM_WS_H
 
+#include <stdint.h>
+
 #include "mongoose.h"
+#include "cJSON.h"
 
 /**
  * @brief WebSocket handler for system logs
@@ -17,14 +20,16 @@
 void websocket_handle_system_logs(const char *client_id, const char *message);
 
 /**
- * @brief Fetch system logs with timestamp-based pagination
+ * @brief Fetch system logs from memory
  * 
  * @param client_id WebSocket client ID
  * @param min_level Minimum log level to include
  * @param last_timestamp Last timestamp received by client (for pagination)
+ * @param last_seq Last sequence number received by client (0 for none)
  * @return int Number of logs sent
  */
-int fetch_system_logs(const char *client_id, const char *min_level, const char *last_timestamp);
+int fetch_system_logs(const char *client_id, const char *min_level, const char *last_timestamp,
+                      uint64_t last_seq);
 
 /**
  * @brief Remove log level for a client
@@ -71,5 +76,21 @@ int get_json_logs(const char *min_level, const char *last_timestamp, char ***log
 
 int log_level_meets_minimum(const char *log_level, const char *min_level);
 
+/**
+ * @brief Build a JSON array of the newest log entries kept in memory
+ *
+ * Each entry is {"seq","timestamp","level","message"}, oldest first.
+ *
+ * @param min_level Minimum log level to include
+ * @param after_seq Only include entries after this sequence number (0 for all)
+ * @param last_timestamp Only include entries after this timestamp (optional)
+ * @param max_count Maximum number of entries
+ * @param latest_seq Set to the sequence number to resume from
+ * @param count Set to the number of entries in the array
+ * @return cJSON* Array of entries, or NULL on error
+ */
+cJSON *get_recent_logs_json(const char *min_level, uint64_t after_seq, const char *last_timestamp,
+                            int max_count, uint64_t *latest_seq, int *count);
+
 
 #endif /* API_HANDLERS_SYSTEM_WS_H */
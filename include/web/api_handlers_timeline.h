@@ -38,17 +38,19 @@ int get_timeline_segments(const char *stream_name, time_t start_time, time_t end
 void handle_get_timeline_segments(const http_request_t *request, http_response_t *response);
 
 /**
- * Create a playback manifest for a sequence of recordings
+ * Create an HLS VOD playlist playing a sequence of recordings
  * 
  * @param segments      Array of segments to include in the manifest
  * @param segment_count Number of segments in the array
  * @param start_time    Requested playback start time
- * @param manifest_path Output path where the manifest will be written
+ * @param end_time      Requested playback end time
+ * @param h264          List HEVC recordings as transcoded H.264 segments
+ * @param length        Receives the length of the manifest
  * 
- * @return 0 on success, non-zero on failure
+ * @return Manifest to release with free, or NULL on failure
  */
-int create_timeline_manifest(const timeline_segment_t *segments, int segment_count,
-                            time_t start_time, char *manifest_path);
+char *create_timeline_manifest(const timeline_segment_t *segments, int segment_count,
+                               time_t start_time, time_t end_time, bool h264, size_t *length);
 
 /**
  * Handle GET request for timeline playback
@@ -0,0 +1,82 @@
+/**
+ * @file api_response_cache.h
+ * @brief Cache of API responses, invalidated by data versions
+ *
+ * Routes that only show data with a version (database tables, stream states,
+ * settings) declare what they depend on. Their responses carry an ETag made
+ * of the request and the sum of those versions, so a client polling with
+ * If-None-Match gets a 304 without the handler running. Other clients with
+ * the same request and credentials are answered from memory until a version
+ * changes. Versions only grow, so a response built after reading the version
+ * is never older than the version it is stored under.
+ */
+
+#ifndef API_RESPONSE_CACHE_H
+#define API_RESPONSE_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "database/db_core.h"
+
+// Forward declarations for Mongoose structures
+struct mg_connection;
+struct mg_http_message;
+
+// What a cached route depends on
+#define API_CACHE_TABLE(t)          (1u << (t))     // A db_table_t group
+#define API_CACHE_STREAM_STATE      (1u << 16)      // Stream states, see get_stream_state_version()
+#define API_CACHE_SETTINGS          (1u << 17)      // g_config, see api_cache_settings_changed()
+#define API_CACHE_CLOCK             (1u << 18)      // The current time, in API_CACHE_CLOCK_SECONDS steps
+
+// Step of API_CACHE_CLOCK, for responses showing the last minutes of data
+#define API_CACHE_CLOCK_SECONDS 5
+
+/**
+ * @brief Cache state of a request, carried from lookup to store
+ */
+typedef struct {
+    bool active;            // The route is cached and the response should be stored
+    uint64_t key;           // Hash of the request and credentials
+    uint64_t version;       // Sum of the versions the route depends on
+} api_cache_ctx_t;
+
+/**
+ * @brief Answer a request from the cache if possible
+ *
+ * Must be called from the event loop thread, before the handler runs.
+ *
+ * @param c Mongoose connection
+ * @param hm Mongoose HTTP message
+ * @param deps API_CACHE_* flags of the route
+ * @param ctx Receives the cache state to hand to api_cache_store()
+ * @return true if a 304 or the cached response was sent
+ */
+bool api_cache_lookup(struct mg_connection *c, struct mg_http_message *hm, unsigned int deps,
+                      api_cache_ctx_t *ctx);
+
+/**
+ * @brief Store the response a handler wrote, and add its ETag
+ *
+ * Only complete 200 responses are stored. The response is rewritten in the
+ * send buffer with an ETag and without Cache-Control: no-store, so browsers
+ * revalidate it.
+ *
+ * @param ctx Cache state from api_cache_lookup()
+ * @param c Connection the handler wrote to
+ * @param start Length of the send buffer before the handler ran
+ */
+void api_cache_store(const api_cache_ctx_t *ctx, struct mg_connection *c, size_t start);
+
+/**
+ * @brief Note that g_config changed
+ */
+void api_cache_settings_changed(void);
+
+/**
+ * @brief Free the cached responses
+ */
+void api_cache_free(void);
+
+#endif /* API_RESPONSE_CACHE_H */
@@ -0,0 +1,75 @@
+/**
+ * @file api_response_compress.h
+ * @brief Compression of API and playlist responses
+ *
+ * Handlers write their responses uncompressed. Once a handler has returned,
+ * a complete JSON, text or HLS playlist response in the send buffer is
+ * compressed with gzip or deflate, whichever the client accepts, when its
+ * body is large enough to gain from it. Chunked responses, such as those of
+ * the streaming JSON writer, stay chunked with a compressed body. Builds
+ * without zlib send responses as they are.
+ */
+
+#ifndef API_RESPONSE_COMPRESS_H
+#define API_RESPONSE_COMPRESS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Forward declarations for Mongoose structures
+struct mg_connection;
+struct mg_http_message;
+
+// Smaller bodies are sent uncompressed
+#define API_COMPRESS_MIN_SIZE 1024
+
+// Content coding of a response
+typedef enum {
+    API_ENCODING_IDENTITY = 0,
+    API_ENCODING_GZIP,
+    API_ENCODING_DEFLATE
+} api_encoding_t;
+
+/**
+ * @brief Check whether the client accepts a content coding
+ *
+ * A coding listed with q=0 counts as refused.
+ *
+ * @param hm Mongoose HTTP message
+ * @param coding Content coding, such as "gzip"
+ * @return true if accepted
+ */
+bool http_accepts_encoding(struct mg_http_message *hm, const char *coding);
+
+/**
+ * @brief Join the chunks of a chunked body
+ *
+ * @param data Body as sent, from the first chunk size to the last chunk
+ * @param size Length of data
+ * @param out_len Receives the length of the joined body
+ * @return Joined body to free, or NULL if the body is incomplete or malformed
+ */
+unsigned char *http_dechunk(const char *data, size_t size, size_t *out_len);
+
+/**
+ * @brief Choose the coding to compress the response to a request with
+ *
+ * @param hm Mongoose HTTP message
+ * @return API_ENCODING_IDENTITY if the response is not to be compressed
+ */
+api_encoding_t api_response_encoding(struct mg_http_message *hm);
+
+/**
+ * @brief Compress the response a handler wrote
+ *
+ * Only complete 200 responses of compressible types without a content
+ * coding are compressed, and only when that makes them smaller. The
+ * response is rewritten in the send buffer.
+ *
+ * @param c Connection the handler wrote to
+ * @param encoding Coding from api_response_encoding()
+ * @param start Length of the send buffer before the handler ran
+ */
+void api_compress_response(struct mg_connection *c, api_encoding_t encoding, size_t start);
+
+#endif /* API_RESPONSE_COMPRESS_H */
@@ -34,8 +34,15 @@ typedef struct {
     bool ssl_enabled;               // SSL/TLS enabled
     char cert_path[256];            // SSL/TLS certificate path
     char key_path[256];             // SSL/TLS key path
-    int max_connections;            // Maximum number of connections
-    int connection_timeout;         // Connection timeout in seconds
+    int max_connections;            // Maximum number of connections (0 = no limit)
+    int max_connections_per_ip;     // Maximum connections of one client address (0 = no limit)
+    int connection_timeout;         // Seconds a connection may be idle (0 = no limit)
+    int header_timeout;             // Seconds a new connection has to send its request headers (0 = no limit)
+    size_t send_buffer_limit;       // Bytes queued on a connection before its producers wait
+    int worker_threads;             // Worker threads for offloaded requests
+    int request_queue_size;         // Offloaded requests that may wait for a worker
+    int route_max_concurrency;      // Workers one route may occupy (0 = no limit)
+    int event_loops;                // Event loops sharing the port via SO_REUSEPORT (1 = one loop)
     bool daemon_mode;               // Daemon mode
     char pid_file[256];             // PID file path
 } http_server_config_t;
@@ -44,7 +51,9 @@ typedef struct {
  * @brief HTTP server structure
  */
 typedef struct http_server {
-    struct mg_mgr *mgr;             // Mongoose event manager
+    struct mg_mgr *mgr;             // Mongoose event manager of the first event loop
+    struct mg_mgr *loop_mgrs[MAX_WEB_EVENT_LOOPS]; // Event manager of each loop, loop_mgrs[0] == mgr
+    int loop_count;                 // Event loops in use
     http_server_config_t config;    // Server configuration
     bool running;                   // Server running flag
     
@@ -108,11 +117,9 @@ int http_server_register_handler(http_server_handle_t server, const char *path,
 /**
  * @brief Get server statistics
  * 
- * Note: This function is kept for API compatibility but no longer tracks statistics
- * 
  * @param server Server handle
  * @param active_connections Number of active connections
- * @param requests_per_second Requests per second
+ * @param requests_per_second Requests per second since the previous call
  * @param bytes_sent Bytes sent
  * @param bytes_received Bytes received
  * @return int 0 on success, non-zero on error
@@ -0,0 +1,63 @@
+/**
+ * @file json_writer.h
+ * @brief Streaming JSON writer for chunked HTTP responses
+ *
+ * Writes JSON straight into a connection as it is produced, in chunks of
+ * JSON_WRITER_BUFFER_SIZE bytes, instead of building a cJSON tree and
+ * printing it into one string first. Meant for responses whose size grows
+ * with the result, such as lists of recordings or detections.
+ *
+ * Values are written with a key inside objects and with a NULL key inside
+ * arrays. The writer does not check that calls are balanced.
+ */
+
+#ifndef JSON_WRITER_H
+#define JSON_WRITER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Forward declaration for Mongoose structure
+struct mg_connection;
+
+// Bytes collected before a chunk is written to the connection
+#define JSON_WRITER_BUFFER_SIZE 4096
+
+// Deepest nesting of objects and arrays
+#define JSON_WRITER_MAX_DEPTH 16
+
+typedef struct {
+    struct mg_connection *c;
+    size_t len;
+    int depth;
+    bool has_items[JSON_WRITER_MAX_DEPTH];   // Per level, whether a comma is needed
+    char buf[JSON_WRITER_BUFFER_SIZE];
+} json_writer_t;
+
+/**
+ * @brief Send the response headers and start writing
+ *
+ * @param w Writer to initialize
+ * @param c Mongoose connection
+ * @param status_code HTTP status code
+ */
+void json_writer_begin(json_writer_t *w, struct mg_connection *c, int status_code);
+
+/**
+ * @brief Write what is left and end the chunked response
+ *
+ * @param w Writer
+ */
+void json_writer_end(json_writer_t *w);
+
+void json_write_object_start(json_writer_t *w, const char *key);
+void json_write_object_end(json_writer_t *w);
+void json_write_array_start(json_writer_t *w, const char *key);
+void json_write_array_end(json_writer_t *w);
+
+void json_write_string(json_writer_t *w, const char *key, const char *value);
+void json_write_number(json_writer_t *w, const char *key, double value);
+void json_write_bool(json_writer_t *w, const char *key, bool value);
+void json_write_null(json_writer_t *w, const char *key);
+
+#endif /* JSON_WRITER_H */
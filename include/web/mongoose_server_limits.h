@@ -0,0 +1,117 @@
+/**
+ * @file mongoose_server_limits.h
+ * @brief Connection limits, timeouts and send buffer caps of the web server
+ *
+ * Bounds what clients can make the server hold on to:
+ *  - web_max_connections and web_max_connections_per_ip cap accepted
+ *    connections across all event loops; further ones get a 503 and are
+ *    closed
+ *  - web_header_timeout closes connections that have not sent their
+ *    request headers in time, such as slowloris clients and stalled TLS
+ *    handshakes
+ *  - web_idle_timeout closes connections on which nothing moved for that
+ *    long, whether the client sent nothing or stopped reading its response;
+ *    WebSockets, blocking LL-HLS requests and requests waiting for a worker
+ *    are left alone
+ *  - web_send_buffer_kb caps what is queued on a connection: file, export
+ *    and WebSocket producers wait until it drains below the cap, and a
+ *    connection whose response went over it is not read from again until
+ *    it has drained
+ *
+ * Connection state is kept per event loop and only touched from its thread.
+ */
+
+#ifndef MONGOOSE_SERVER_LIMITS_H
+#define MONGOOSE_SERVER_LIMITS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "web/http_server.h"
+
+// Forward declarations for Mongoose structures
+struct mg_connection;
+struct mg_mgr;
+
+/**
+ * @brief Take the limits from the server configuration
+ *
+ * @param config Server configuration
+ */
+void mg_limits_init(const http_server_config_t *config);
+
+/**
+ * @brief Count a connection just accepted, or turn it away
+ *
+ * Must be called on MG_EV_ACCEPT, before anything else is done with it.
+ *
+ * @param c Mongoose connection
+ * @param tls Whether the connection is going to use TLS, so no plain 503 is sent
+ * @return true if the connection is accepted, false if it is being closed
+ */
+bool mg_limits_accept(struct mg_connection *c, bool tls);
+
+/**
+ * @brief Note an event of a connection
+ *
+ * Tracks reads, writes, headers and worker responses, and resumes reading
+ * once the send buffer has drained.
+ *
+ * @param c Mongoose connection
+ * @param ev Mongoose event
+ * @param ev_data Event data
+ */
+void mg_limits_event(struct mg_connection *c, int ev, void *ev_data);
+
+/**
+ * @brief Check a connection after its request was handled
+ *
+ * Notes that the response is coming from a worker when nothing was queued,
+ * and stops reading while the send buffer is over the cap.
+ *
+ * @param c Mongoose connection
+ */
+void mg_limits_after_request(struct mg_connection *c);
+
+/**
+ * @brief Note bytes sent outside of Mongoose, such as with sendfile()
+ *
+ * @param c Mongoose connection
+ * @param bytes Bytes sent
+ */
+void mg_limits_touch(struct mg_connection *c, size_t bytes);
+
+/**
+ * @brief Forget a connection on MG_EV_CLOSE
+ *
+ * @param c Mongoose connection
+ */
+void mg_limits_close(struct mg_connection *c);
+
+/**
+ * @brief Close the connections of an event loop that ran out of time
+ *
+ * Called from the event loop about once a second.
+ *
+ * @param mgr Event manager of the loop
+ */
+void mg_limits_sweep(struct mg_mgr *mgr);
+
+/**
+ * @brief Bytes producers may queue on a connection before waiting for it to drain
+ */
+size_t mg_send_limit(void);
+
+/**
+ * @brief Get the totals of all event loops
+ *
+ * @param active_connections Connections open now
+ * @param requests Requests received
+ * @param bytes_sent Bytes written to sockets
+ * @param bytes_received Bytes read from sockets
+ */
+void mg_limits_get_totals(int *active_connections, uint64_t *requests,
+                          uint64_t *bytes_sent, uint64_t *bytes_received);
+
+#endif /* MONGOOSE_SERVER_LIMITS_H */
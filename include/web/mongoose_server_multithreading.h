@@ -7,6 +7,8 @@
 #define MONGOOSE_SERVER_MULTITHREADING_H
 
 #include "mongoose.h"
+#include "core/metrics.h"
+#include "web/api_response_cache.h"
 
 /**
  * @brief Thread data structure for worker threads
@@ -16,15 +18,73 @@ struct mg_thread_data {
   unsigned long conn_id;  // Parent connection ID
   struct mg_str message;  // Original HTTP request
   void (*handler_func)(struct mg_connection *c, struct mg_http_message *hm);  // Handler function
+  metric_t metric;        // Request latency histogram of the route, 0 for none
+  uint64_t queued_us;     // When the request was queued, see metrics_now_us()
+  api_cache_ctx_t cache;  // Where to store the response of a cached route
 };
 
 /**
- * @brief Start a thread
- * 
+ * @brief Start the worker pool that runs offloaded requests
+ *
+ * Requests wait in a bounded queue for one of a fixed number of workers.
+ * When the queue is full new requests are refused, and a handler may only
+ * occupy route_limit workers at once so a slow route cannot starve the rest.
+ *
+ * @param threads Number of worker threads
+ * @param queue_size Number of requests that may wait for a worker
+ * @param route_limit Workers one handler may occupy at once (0 = no limit)
+ * @return int 0 on success, -1 on error
+ */
+int mg_worker_pool_start(int threads, int queue_size, int route_limit);
+
+/**
+ * @brief Stop the worker pool
+ *
+ * Waits for running requests to finish; queued requests are dropped.
+ */
+void mg_worker_pool_stop(void);
+
+/**
+ * @brief Run a function on the worker pool
+ *
+ * Without a running pool the function gets a detached thread of its own.
+ *
  * @param f Thread function
  * @param p Thread data
+ * @return int 0 on success, -1 if the queue is full (p is not used)
+ */
+int mg_start_thread(void *(*f)(void *), void *p);
+
+/**
+ * @brief Hand a request to the worker pool
+ *
+ * Replies 503 with Retry-After when the queue is full, or 500 on
+ * allocation failure.
+ *
+ * @param c Mongoose connection
+ * @param hm HTTP message
+ * @param handler_func Handler to run on a worker
+ * @return true if the request was queued, false if an error was sent
+ */
+bool mg_offload_request(struct mg_connection *c, struct mg_http_message *hm,
+                        void (*handler_func)(struct mg_connection *c, struct mg_http_message *hm));
+
+/**
+ * @brief Hand a request for an API route to the worker pool
+ *
+ * As mg_offload_request(), and records the time from queueing the request
+ * to the handler returning in the route's latency histogram.
+ *
+ * @param c Mongoose connection
+ * @param hm HTTP message
+ * @param handler_func Handler to run on a worker
+ * @param metric Request latency histogram, 0 for none
+ * @param cache Cache state from api_cache_lookup(), NULL for none
+ * @return true if the request was queued, false if an error was sent
  */
-void mg_start_thread(void *(*f)(void *), void *p);
+bool mg_offload_route(struct mg_connection *c, struct mg_http_message *hm,
+                      void (*handler_func)(struct mg_connection *c, struct mg_http_message *hm),
+                      metric_t metric, const api_cache_ctx_t *cache);
 
 /**
  * @brief Thread function that processes the request
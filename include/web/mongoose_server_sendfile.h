@@ -0,0 +1,95 @@
+/**
+ * @file mongoose_server_sendfile.h
+ * @brief Zero-copy file responses for plain HTTP and kernel TLS connections
+ */
+
+#ifndef MONGOOSE_SERVER_SENDFILE_H
+#define MONGOOSE_SERVER_SENDFILE_H
+
+#include <sys/types.h>
+
+// Forward declarations for Mongoose structures
+struct mg_connection;
+struct mg_http_message;
+
+// Marks connections with a file transfer in progress in c->data[0]
+#define MG_SENDFILE_MARK 'F'
+
+/**
+ * @brief Serve a file with sendfile(), including single-range requests
+ *
+ * The headers go through Mongoose's send buffer; the body is then sent
+ * from the page cache straight to the socket by mg_poll_file_transfer, so
+ * it is never copied through user space. TLS connections the kernel does
+ * not encrypt for, and requests beyond the number of concurrent
+ * transfers, fall back to mg_http_serve_file. Must be called from the
+ * event loop thread.
+ *
+ * @param c Mongoose connection
+ * @param hm Mongoose HTTP message, for Range, If-None-Match and HEAD
+ * @param path Path of the file
+ * @param extra_headers Headers to add, including Content-Type, each ending in \r\n
+ */
+void mg_serve_file_zero_copy(struct mg_connection *c, struct mg_http_message *hm,
+                             const char *path, const char *extra_headers);
+
+/**
+ * @brief Serve the head of a file followed by its tail, with sendfile()
+ *
+ * The response body is bytes [0, head_len) of the file followed by bytes
+ * [tail_offset, end), and single-range requests address that body. Used to
+ * serve a fragmented MP4 from one of its fragments: the head holds the
+ * ftyp and moov boxes, the tail starts at a moof box. Must be called from
+ * the event loop thread.
+ *
+ * @param c Mongoose connection
+ * @param hm Mongoose HTTP message, for Range, If-None-Match and HEAD
+ * @param path Path of the file
+ * @param head_len Bytes taken from the start of the file
+ * @param tail_offset Offset the rest of the body is taken from
+ * @param extra_headers Headers to add, including Content-Type, each ending in \r\n
+ * @return 0 if a response was sent, -1 if none was sent because the
+ *         connection cannot use sendfile (TLS in user space, or all
+ *         transfers busy)
+ */
+int mg_serve_file_spliced(struct mg_connection *c, struct mg_http_message *hm, const char *path,
+                          off_t head_len, off_t tail_offset, const char *extra_headers);
+
+/**
+ * @brief Serve files one after the other as one body, including single-range requests
+ *
+ * The files are opened in turn as the body reaches them, so any number can
+ * be concatenated. Used to serve a recording kept as HLS segments as one
+ * fragmented MP4: its initialization section followed by the segments.
+ * Unlike single files, TLS connections encrypted in user space are served
+ * too, by reading the files into the send buffer. Must be called from the event loop thread.
+ *
+ * @param c Mongoose connection
+ * @param hm Mongoose HTTP message, for Range, If-None-Match and HEAD
+ * @param paths Paths of the files, copied
+ * @param count Number of files
+ * @param extra_headers Headers to add, including Content-Type, each ending in \r\n
+ * @return 0 if a response was sent, -1 if none was sent because all
+ *         transfers are busy or the connection has no socket
+ */
+int mg_serve_files_concat(struct mg_connection *c, struct mg_http_message *hm,
+                          const char *const *paths, int count, const char *extra_headers);
+
+/**
+ * @brief Send the next part of a connection's file transfer
+ *
+ * Called from the event loop for connections marked with MG_SENDFILE_MARK
+ * in c->data[0].
+ *
+ * @param c Mongoose connection
+ */
+void mg_poll_file_transfer(struct mg_connection *c);
+
+/**
+ * @brief Drop the file transfer of a closing connection
+ *
+ * @param c Mongoose connection
+ */
+void mg_cancel_file_transfer(struct mg_connection *c);
+
+#endif /* MONGOOSE_SERVER_SENDFILE_H */
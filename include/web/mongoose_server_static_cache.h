@@ -0,0 +1,49 @@
+/**
+ * @file mongoose_server_static_cache.h
+ * @brief In-memory cache of the web interface files
+ *
+ * The files under web_root are read once at startup, together with gzip
+ * and brotli variants: .gz and .br files next to them when the build
+ * produced them, otherwise gzip compressed here when zlib is available.
+ * Responses carry content hash ETags, so revalidation is a 304 without
+ * touching the disk, and files under /assets/, whose names carry a
+ * content hash, are marked immutable. Changes to web_root take effect
+ * after a restart.
+ */
+
+#ifndef MONGOOSE_SERVER_STATIC_CACHE_H
+#define MONGOOSE_SERVER_STATIC_CACHE_H
+
+#include <stdbool.h>
+
+// Forward declarations for Mongoose structures
+struct mg_connection;
+struct mg_http_message;
+
+/**
+ * @brief Load the web interface files into memory
+ *
+ * @param web_root Directory holding the web interface
+ * @param compress Whether to serve compressed variants
+ * @return int Number of files cached, or -1 on error
+ */
+int static_cache_init(const char *web_root, bool compress);
+
+/**
+ * @brief Free the cached files
+ */
+void static_cache_free(void);
+
+/**
+ * @brief Answer a request from the cache
+ *
+ * Must be called from the event loop thread.
+ *
+ * @param c Mongoose connection
+ * @param hm Mongoose HTTP message
+ * @param path Path of the file below web_root, starting with '/'
+ * @return true if the file is cached and was sent, false otherwise
+ */
+bool static_cache_serve(struct mg_connection *c, struct mg_http_message *hm, const char *path);
+
+#endif /* MONGOOSE_SERVER_STATIC_CACHE_H */
@@ -0,0 +1,41 @@
+/**
+ * @file mongoose_server_tls.h
+ * @brief TLS setup of accepted HTTPS connections
+ *
+ * All connections share one set of session ticket keys, so players that
+ * reconnect resume their session instead of running a full handshake.
+ * With OpenSSL 3 on Linux, records are also written to the socket by
+ * OpenSSL itself with kernel TLS enabled; once the handshake has handed the
+ * keys to the kernel, file bodies go out with sendfile() as on plain HTTP.
+ * Other TLS libraries, and kernels without the tls module, keep encrypting
+ * in user space.
+ */
+
+#ifndef MONGOOSE_SERVER_TLS_H
+#define MONGOOSE_SERVER_TLS_H
+
+#include <stdbool.h>
+
+// Forward declarations for Mongoose structures
+struct mg_connection;
+
+/**
+ * @brief Set up TLS on a connection just accepted by an HTTPS listener
+ *
+ * Must be called on MG_EV_ACCEPT, before the handshake starts.
+ *
+ * @param c Mongoose connection
+ * @param cert_path Certificate path
+ * @param key_path Key path
+ */
+void mg_tls_setup_accepted(struct mg_connection *c, const char *cert_path, const char *key_path);
+
+/**
+ * @brief Whether the kernel encrypts what is written to the connection's socket
+ *
+ * @param c Mongoose connection
+ * @return true once the handshake is done and kernel TLS transmit is active
+ */
+bool mg_tls_kernel_send(const struct mg_connection *c);
+
+#endif /* MONGOOSE_SERVER_TLS_H */
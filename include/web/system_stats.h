@@ -0,0 +1,84 @@
+/**
+ * @file system_stats.h
+ * @brief Background sampler of the system figures shown by /api/system/info
+ *
+ * A thread refreshes CPU, memory, disk, network and recording figures every
+ * few seconds into a snapshot that handlers copy without touching /proc, the
+ * disk or the database, so polling dashboards cost next to nothing.
+ */
+
+#ifndef SYSTEM_STATS_H
+#define SYSTEM_STATS_H
+
+#include <stdbool.h>
+#include <time.h>
+
+// Seconds between samples of CPU, memory, network and counts
+#define SYSTEM_STATS_SAMPLE_SECONDS 5
+
+// Seconds between samples of storage usage and go2rtc memory, which walk the
+// recordings directory and spawn processes
+#define SYSTEM_STATS_SLOW_SAMPLE_SECONDS 60
+
+// Network interfaces kept in a snapshot
+#define SYSTEM_STATS_MAX_INTERFACES 8
+
+typedef struct {
+    char name[32];
+    char address[64];
+    char mac[32];
+    bool up;
+} system_stats_interface_t;
+
+typedef struct {
+    time_t sampled;                         // When the snapshot was taken
+
+    char cpu_model[65];
+    int cpu_cores;
+    double cpu_usage;                       // Percent over the last sample period
+
+    unsigned long long system_memory_total;
+    unsigned long long system_memory_free;
+    unsigned long long process_memory;      // Resident memory of LightNVR
+    unsigned long long go2rtc_memory;       // Resident memory of go2rtc, 0 if not running
+
+    double uptime;                          // Seconds since LightNVR started
+
+    bool have_disk;
+    unsigned long long disk_total;          // Filesystem of the storage path
+    unsigned long long disk_free;
+    unsigned long long storage_used;        // Size of the storage directory
+    bool have_system_disk;
+    unsigned long long system_disk_total;   // Root filesystem
+    unsigned long long system_disk_free;
+
+    int interface_count;
+    system_stats_interface_t interfaces[SYSTEM_STATS_MAX_INTERFACES];
+
+    int enabled_streams;
+    int recording_count;
+} system_stats_t;
+
+/**
+ * @brief Start the sampler thread
+ *
+ * @return 0 on success, -1 on failure
+ */
+int system_stats_start(void);
+
+/**
+ * @brief Stop the sampler thread
+ */
+void system_stats_stop(void);
+
+/**
+ * @brief Copy the latest snapshot
+ *
+ * Never blocks on the sampler.
+ *
+ * @param stats Receives the snapshot, zeroed if there is none yet
+ * @return true if a snapshot was copied, false before the first sample
+ */
+bool system_stats_get(system_stats_t *stats);
+
+#endif /* SYSTEM_STATS_H */
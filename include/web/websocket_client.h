@@ -2,8 +2,43 @@
 #define WEBSOCKET_CLIENT_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include "mongoose.h"
 
+/**
+ * A message serialized once and shared by every client it is queued for
+ * Freed when the last reference is dropped.
+ */
+typedef struct {
+    int refs;
+    size_t len;
+    char data[];
+} ws_message_t;
+
+/**
+ * What to do when a client's send queue is full
+ */
+typedef enum {
+    WS_DROP_OLDEST,     // Drop the client's oldest queued message, for updates that supersede each other
+    WS_DROP_CLIENT      // Close the client, for streams that must not have gaps
+} ws_drop_policy_t;
+
+/**
+ * @brief Create a message holding one reference
+ *
+ * @param data Message data
+ * @param len Message length
+ * @return ws_message_t* Message, or NULL on error
+ */
+ws_message_t *websocket_message_new(const char *data, size_t len);
+
+/**
+ * @brief Drop a reference to a message, freeing it with the last one
+ *
+ * @param msg Message
+ */
+void websocket_message_unref(ws_message_t *msg);
+
 /**
  * @brief Find a client by ID
  * 
@@ -84,4 +119,37 @@ void websocket_client_cleanup_inactive(void);
  */
 struct mg_connection* websocket_client_get_connection(const char *client_id);
 
+/**
+ * @brief Queue a message for every subscriber of a topic
+ * Safe to call from any thread; the subscribers take their own references.
+ *
+ * @param topic Topic
+ * @param msg Message
+ * @param policy What to do for subscribers whose queue is full
+ * @return int Number of clients the message was queued for
+ */
+int websocket_client_queue_topic(const char *topic, ws_message_t *msg, ws_drop_policy_t policy);
+
+/**
+ * @brief Queue a message for the client of a connection
+ * Safe to call from any thread; the connection is only compared, never
+ * dereferenced, so it may already be closed.
+ *
+ * @param conn Mongoose connection
+ * @param msg Message
+ * @param policy What to do if the client's queue is full
+ * @return bool true if the message was queued
+ */
+bool websocket_client_queue_connection(const struct mg_connection *conn, ws_message_t *msg,
+                                       ws_drop_policy_t policy);
+
+/**
+ * @brief Send queued messages, and close clients that fell too far behind
+ * A client's messages wait while its connection still has a lot unsent.
+ * Must be called from the thread of the event loop that owns the connections.
+ *
+ * @param mgr Manager of the calling event loop; clients of other loops are skipped
+ */
+void websocket_client_flush(struct mg_mgr *mgr);
+
 #endif /* WEBSOCKET_CLIENT_H */
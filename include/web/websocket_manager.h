@@ -5,6 +5,7 @@
 #include <stddef.h>
 #include "mongoose.h"
 #include "web/websocket_handler.h"
+#include "web/websocket_client.h"
 
 /**
  * @brief Initialize WebSocket manager
@@ -60,6 +61,8 @@ int websocket_manager_register_handler(const char *topic, websocket_handler_t ha
 
 /**
  * @brief Broadcast a message to all WebSocket clients
+ * Connections with a lot still unsent are skipped. Must be called from
+ * the event loop thread.
  * 
  * @param mgr Mongoose manager
  * @param data Message data
@@ -68,4 +71,42 @@ int websocket_manager_register_handler(const char *topic, websocket_handler_t ha
  */
 int websocket_manager_broadcast(struct mg_mgr *mgr, const char *data, size_t data_len);
 
+/**
+ * @brief Publish a message to the subscribers of a topic
+ * 
+ * The message is copied once and shared by the queues of all subscribers;
+ * websocket_manager_flush() sends it from the event loop. Safe to call
+ * from any thread.
+ * 
+ * @param topic Topic name
+ * @param data Message data
+ * @param data_len Message data length
+ * @param policy What to do for subscribers whose queue is full
+ * @return int Number of clients the message was queued for
+ */
+int websocket_manager_publish(const char *topic, const char *data, size_t data_len, ws_drop_policy_t policy);
+
+/**
+ * @brief Queue a message for the client of one connection
+ * 
+ * Like websocket_manager_publish(), for replies and progress updates to
+ * the client that asked. Safe to call from any thread.
+ * 
+ * @param c Mongoose connection, which may already be closed
+ * @param data Message data
+ * @param data_len Message data length
+ * @param policy What to do if the client's queue is full
+ * @return bool true if the message was queued
+ */
+bool websocket_manager_send(const struct mg_connection *c, const char *data, size_t data_len,
+                            ws_drop_policy_t policy);
+
+/**
+ * @brief Send queued messages
+ * Called by each event loop after every poll.
+ *
+ * @param mgr Manager of the calling event loop; only its connections are served
+ */
+void websocket_manager_flush(struct mg_mgr *mgr);
+
 #endif // WEBSOCKET_MANAGER_H
@@ -0,0 +1,369 @@
+#!/bin/bash
+# Synthetic multi-camera load test
+#
+# Publishes N synthetic RTSP cameras from a private go2rtc instance (FFmpeg
+# test pattern or a looped file), runs lightnvr against them with HLS,
+# MP4 recording and optionally detection, and reports per-stream ingest
+# FPS, dropped packets, write latency, detection throughput and the CPU
+# and RSS of the process as JSON.
+#
+# Everything lives in a scratch directory; nothing in /etc or /var is touched.
+
+set -e
+
+# Default values
+STREAMS=4
+SIZE="1280x720"
+FPS=15
+BITRATE="2M"
+GOP=2            # Keyframe interval in seconds
+CODEC="libx264"
+SOURCE_FILE=""
+MODEL=""
+WARMUP=30
+DURATION=60
+LIGHTNVR="./build/Release/bin/lightnvr"
+GO2RTC="/usr/local/bin/go2rtc"
+WORK_DIR=""
+KEEP=0
+OUTPUT=""
+WEB_PORT=18080
+GO2RTC_API_PORT=11985   # lightnvr's own go2rtc
+SOURCE_API_PORT=11984   # Synthetic cameras
+SOURCE_RTSP_PORT=18554
+
+# Display usage information
+usage() {
+    echo "Usage: $0 [options]"
+    echo "Options:"
+    echo "  -n, --streams N         Number of synthetic cameras (default: $STREAMS)"
+    echo "  -s, --size WxH          Resolution of the test pattern (default: $SIZE)"
+    echo "  -f, --fps N             Frame rate (default: $FPS)"
+    echo "  -b, --bitrate RATE      Video bitrate, FFmpeg syntax (default: $BITRATE)"
+    echo "  -g, --gop SECONDS       Keyframe interval (default: $GOP)"
+    echo "  -c, --codec CODEC       FFmpeg encoder, e.g. libx264 or libx265 (default: $CODEC)"
+    echo "  -i, --input FILE        Loop FILE instead of the test pattern (copied, not re-encoded)"
+    echo "  -m, --model MODEL       Run detection with MODEL on every stream"
+    echo "  -w, --warmup SECONDS    Time to let streams settle before measuring (default: $WARMUP)"
+    echo "  -d, --duration SECONDS  Measurement time (default: $DURATION)"
+    echo "  -l, --lightnvr PATH     lightnvr binary (default: $LIGHTNVR)"
+    echo "  -G, --go2rtc PATH       go2rtc binary (default: $GO2RTC)"
+    echo "  -p, --port PORT         Web port of the lightnvr under test (default: $WEB_PORT)"
+    echo "  -W, --work-dir DIR      Scratch directory (default: a new temporary directory)"
+    echo "  -k, --keep              Keep the scratch directory (logs, recordings)"
+    echo "  -o, --output FILE       Write the JSON report to FILE instead of stdout"
+    echo "  -h, --help              Display this help message"
+    exit 1
+}
+
+# Parse command line arguments
+while [[ $# -gt 0 ]]; do
+    case $1 in
+        -n|--streams) STREAMS="$2"; shift 2 ;;
+        -s|--size) SIZE="$2"; shift 2 ;;
+        -f|--fps) FPS="$2"; shift 2 ;;
+        -b|--bitrate) BITRATE="$2"; shift 2 ;;
+        -g|--gop) GOP="$2"; shift 2 ;;
+        -c|--codec) CODEC="$2"; shift 2 ;;
+        -i|--input) SOURCE_FILE="$2"; shift 2 ;;
+        -m|--model) MODEL="$2"; shift 2 ;;
+        -w|--warmup) WARMUP="$2"; shift 2 ;;
+        -d|--duration) DURATION="$2"; shift 2 ;;
+        -l|--lightnvr) LIGHTNVR="$2"; shift 2 ;;
+        -G|--go2rtc) GO2RTC="$2"; shift 2 ;;
+        -p|--port) WEB_PORT="$2"; shift 2 ;;
+        -W|--work-dir) WORK_DIR="$2"; shift 2 ;;
+        -k|--keep) KEEP=1; shift ;;
+        -o|--output) OUTPUT="$2"; shift 2 ;;
+        -h|--help) usage ;;
+        *) echo "Unknown option: $1"; usage ;;
+    esac
+done
+
+log() {
+    echo "[load_test] $*" >&2
+}
+
+die() {
+    log "ERROR: $*"
+    KEEP=1  # Leave the logs for a look
+    exit 1
+}
+
+for tool in curl awk ffmpeg; do
+    command -v "$tool" > /dev/null || die "$tool is required"
+done
+[ -x "$LIGHTNVR" ] || die "lightnvr binary not found at $LIGHTNVR (use --lightnvr)"
+[ -x "$GO2RTC" ] || die "go2rtc binary not found at $GO2RTC (use --go2rtc or scripts/install_go2rtc.sh)"
+[ -z "$SOURCE_FILE" ] || [ -f "$SOURCE_FILE" ] || die "input file $SOURCE_FILE not found"
+[[ "$SIZE" =~ ^[0-9]+x[0-9]+$ ]] || die "size must be WIDTHxHEIGHT"
+[ "$STREAMS" -ge 1 ] 2>/dev/null || die "streams must be a positive number"
+
+WIDTH=${SIZE%x*}
+HEIGHT=${SIZE#*x}
+CLK_TCK=$(getconf CLK_TCK)
+BASE_URL="http://127.0.0.1:$WEB_PORT"
+
+if [ -z "$WORK_DIR" ]; then
+    WORK_DIR=$(mktemp -d /tmp/lightnvr_load_XXXXXX)
+fi
+mkdir -p "$WORK_DIR"/{recordings/mp4,models,go2rtc,www}
+WORK_DIR=$(cd "$WORK_DIR" && pwd)
+
+SOURCE_PID=""
+LIGHTNVR_PID=""
+
+cleanup() {
+    if [ -n "$LIGHTNVR_PID" ] && kill -0 "$LIGHTNVR_PID" 2>/dev/null; then
+        log "Stopping lightnvr"
+        kill -TERM "$LIGHTNVR_PID" 2>/dev/null || true
+        for _ in $(seq 1 30); do
+            kill -0 "$LIGHTNVR_PID" 2>/dev/null || break
+            sleep 1
+        done
+        kill -KILL "$LIGHTNVR_PID" 2>/dev/null || true
+    fi
+    if [ -n "$SOURCE_PID" ]; then
+        kill -TERM "$SOURCE_PID" 2>/dev/null || true
+    fi
+    if [ "$KEEP" -eq 1 ]; then
+        log "Scratch directory kept at $WORK_DIR"
+    else
+        rm -rf "$WORK_DIR"
+    fi
+}
+trap cleanup EXIT
+trap 'exit 130' INT TERM
+
+# Synthetic cameras, published by go2rtc when lightnvr connects
+{
+    echo "api:"
+    echo "  listen: \"127.0.0.1:$SOURCE_API_PORT\""
+    echo "rtsp:"
+    echo "  listen: \"127.0.0.1:$SOURCE_RTSP_PORT\""
+    echo "webrtc:"
+    echo "  listen: \"\""
+    echo "streams:"
+    for i in $(seq 0 $((STREAMS - 1))); do
+        if [ -n "$SOURCE_FILE" ]; then
+            echo "  load$i: 'exec:ffmpeg -hide_banner -loglevel error -re -stream_loop -1 -i $SOURCE_FILE -c copy -rtsp_transport tcp -f rtsp {output}'"
+        else
+            echo "  load$i: 'exec:ffmpeg -hide_banner -loglevel error -re -f lavfi -i testsrc2=size=${SIZE}:rate=${FPS} -c:v $CODEC -preset ultrafast -tune zerolatency -g $((FPS * GOP)) -b:v $BITRATE -pix_fmt yuv420p -rtsp_transport tcp -f rtsp {output}'"
+        fi
+    done
+} > "$WORK_DIR/source.yaml"
+
+# lightnvr configuration, private to this run
+cat > "$WORK_DIR/lightnvr.ini" << EOF
+[general]
+pid_file = $WORK_DIR/lightnvr.pid
+log_file = $WORK_DIR/lightnvr.log
+log_level = 1
+
+[storage]
+path = $WORK_DIR/recordings
+mp4_path = $WORK_DIR/recordings/mp4
+retention_days = 1
+
+[database]
+path = $WORK_DIR/lightnvr.db
+
+[web]
+port = $WEB_PORT
+root = $WORK_DIR/www
+auth_enabled = false
+
+[streams]
+max_streams = $STREAMS
+
+[models]
+path = $WORK_DIR/models
+
+[go2rtc]
+binary_path = $GO2RTC
+config_dir = $WORK_DIR/go2rtc
+api_port = $GO2RTC_API_PORT
+EOF
+
+if [ -n "$MODEL" ]; then
+    [ -f "$MODEL" ] || die "model $MODEL not found"
+    cp "$MODEL" "$WORK_DIR/models/"
+    MODEL=$(basename "$MODEL")
+fi
+
+log "Starting $STREAMS synthetic cameras on rtsp://127.0.0.1:$SOURCE_RTSP_PORT"
+"$GO2RTC" -config "$WORK_DIR/source.yaml" > "$WORK_DIR/source.log" 2>&1 &
+SOURCE_PID=$!
+
+log "Starting lightnvr with work directory $WORK_DIR"
+"$LIGHTNVR" -c "$WORK_DIR/lightnvr.ini" > "$WORK_DIR/stdout.log" 2>&1 &
+LIGHTNVR_PID=$!
+
+for _ in $(seq 1 60); do
+    kill -0 "$LIGHTNVR_PID" 2>/dev/null || die "lightnvr exited, see $WORK_DIR/stdout.log"
+    curl -sf "$BASE_URL/api/health" > /dev/null 2>&1 && break
+    sleep 1
+done
+curl -sf "$BASE_URL/api/health" > /dev/null 2>&1 || die "lightnvr did not become healthy"
+
+for i in $(seq 0 $((STREAMS - 1))); do
+    detection="false"
+    [ -n "$MODEL" ] && detection="true"
+    body="{\"name\":\"load$i\",\"url\":\"rtsp://127.0.0.1:$SOURCE_RTSP_PORT/load$i\",\"enabled\":true,"
+    body+="\"streaming_enabled\":true,\"record\":true,\"width\":$WIDTH,\"height\":$HEIGHT,\"fps\":$FPS,"
+    body+="\"codec\":\"h264\",\"priority\":5,\"segment_duration\":60,"
+    body+="\"detection_based_recording\":$detection,\"detection_model\":\"$MODEL\"}"
+    curl -sf -X POST -H 'Content-Type: application/json' -d "$body" "$BASE_URL/api/streams" > /dev/null \
+        || die "failed to add stream load$i"
+done
+
+log "Added $STREAMS streams, warming up for ${WARMUP}s"
+sleep "$WARMUP"
+
+# utime + stime of the process, in clock ticks
+process_ticks() {
+    awk '{ sub(/^.*\) /, ""); print $12 + $13 }' "/proc/$LIGHTNVR_PID/stat"
+}
+
+process_rss_kb() {
+    awk '/^VmRSS:/ { print $2 }' "/proc/$LIGHTNVR_PID/status"
+}
+
+curl -sf "$BASE_URL/metrics" > "$WORK_DIR/metrics_before.txt" || die "failed to scrape /metrics"
+ticks_before=$(process_ticks)
+start_ns=$(date +%s%N)
+
+log "Measuring for ${DURATION}s"
+rss_sum=0
+rss_max=0
+samples=0
+for _ in $(seq 1 "$DURATION"); do
+    sleep 1
+    kill -0 "$LIGHTNVR_PID" 2>/dev/null || die "lightnvr exited during the run, see $WORK_DIR/stdout.log"
+    rss=$(process_rss_kb)
+    rss_sum=$((rss_sum + rss))
+    [ "$rss" -gt "$rss_max" ] && rss_max=$rss
+    samples=$((samples + 1))
+done
+
+curl -sf "$BASE_URL/metrics" > "$WORK_DIR/metrics_after.txt" || die "failed to scrape /metrics"
+ticks_after=$(process_ticks)
+end_ns=$(date +%s%N)
+threads=$(awk '/^Threads:/ { print $2 }' "/proc/$LIGHTNVR_PID/status")
+
+elapsed=$(awk -v a="$start_ns" -v b="$end_ns" 'BEGIN { printf "%.3f", (b - a) / 1e9 }')
+cpu_percent=$(awk -v t="$((ticks_after - ticks_before))" -v hz="$CLK_TCK" -v s="$elapsed" \
+    'BEGIN { printf "%.1f", t / hz / s * 100 }')
+cpu_model=$(awk -F': ' '/^model name|^Model|^Hardware/ { print $2; exit }' /proc/cpuinfo | tr -d '"\\')
+mem_total_kb=$(awk '/^MemTotal:/ { print $2 }' /proc/meminfo)
+
+# Per-stream figures from the difference between the two scrapes
+streams_json=$(awk -v elapsed="$elapsed" -v streams="$STREAMS" -v fps="$FPS" '
+function label(series, key,    m) {
+    if (match(series, key "=\"[^\"]*\"")) {
+        m = substr(series, RSTART + length(key) + 2, RLENGTH - length(key) - 3)
+        return m
+    }
+    return ""
+}
+# Upper bound of the bucket holding the q quantile of a histogram
+function quantile(prefix, stream, count, q,    i, j, n, b, tmp, bounds, parts) {
+    if (count <= 0) return -1
+    n = 0
+    for (b in bucket) {
+        split(b, parts, SUBSEP)
+        if (parts[1] == prefix && parts[2] == stream && parts[3] != "+Inf") bounds[++n] = parts[3] + 0
+    }
+    for (i = 2; i <= n; i++) {
+        tmp = bounds[i]
+        for (j = i - 1; j >= 1 && bounds[j] > tmp; j--) bounds[j + 1] = bounds[j]
+        bounds[j + 1] = tmp
+    }
+    for (i = 1; i <= n; i++) {
+        for (b in bucket) {
+            split(b, parts, SUBSEP)
+            if (parts[1] == prefix && parts[2] == stream && parts[3] + 0 == bounds[i] && parts[3] != "+Inf" &&
+                bucket[b] >= q * count) return bounds[i]
+        }
+    }
+    return -1
+}
+function ms(seconds) {
+    return seconds < 0 ? -1 : seconds * 1000
+}
+function avg_ms(prefix, stream) {
+    return count[prefix, stream] > 0 ? sum[prefix, stream] / count[prefix, stream] * 1000 : -1
+}
+/^#/ { next }
+{
+    series = $1
+    value = $2 + 0
+    if (FNR == NR) { before[series] = value; next }
+    delta = value - before[series]
+    stream = label(series, "stream")
+    if (stream == "") next
+    name = series
+    sub(/\{.*/, "", name)
+
+    if (name == "lightnvr_ingest_video_frames_total") frames[stream] += delta
+    else if (name == "lightnvr_ingest_bytes_total") bytes[stream] += delta
+    else if (name == "lightnvr_ingest_packets_dropped_total") drops[stream] += delta
+    else if (name == "lightnvr_stream_reconnects_total") reconnects[stream] += delta
+    else if (name ~ /_bucket$/) {
+        prefix = name
+        sub(/_bucket$/, "", prefix)
+        bucket[prefix, stream, label(series, "le")] += delta
+    } else if (name ~ /_sum$/) {
+        prefix = name
+        sub(/_sum$/, "", prefix)
+        sum[prefix, stream] += delta
+    } else if (name ~ /_count$/) {
+        prefix = name
+        sub(/_count$/, "", prefix)
+        count[prefix, stream] += delta
+    }
+}
+END {
+    mp4 = "lightnvr_mp4_write_seconds"
+    hls = "lightnvr_hls_segment_write_seconds"
+    det = "lightnvr_detection_seconds"
+    total_fps = 0
+    total_drops = 0
+    sustained = 1
+    for (i = 0; i < streams; i++) {
+        s = "load" i
+        stream_fps = frames[s] / elapsed
+        total_fps += stream_fps
+        total_drops += drops[s]
+        if (stream_fps < fps * 0.95 || drops[s] > 0 || reconnects[s] > 0) sustained = 0
+        printf "%s    {\"name\": \"%s\", \"ingest_fps\": %.2f, \"ingest_kbps\": %.1f, ", \
+            (i ? ",\n" : ""), s, stream_fps, bytes[s] * 8 / 1000 / elapsed
+        printf "\"dropped_packets\": %d, \"reconnects\": %d, ", drops[s], reconnects[s]
+        printf "\"mp4_write_ms\": {\"avg\": %.3f, \"p95\": %.3f}, ", \
+            avg_ms(mp4, s), ms(quantile(mp4, s, count[mp4, s], 0.95))
+        printf "\"hls_segment_write_ms\": {\"avg\": %.3f, \"p95\": %.3f}, ", \
+            avg_ms(hls, s), ms(quantile(hls, s, count[hls, s], 0.95))
+        printf "\"detection_fps\": %.2f, \"detection_ms\": {\"avg\": %.3f, \"p95\": %.3f}}", \
+            count[det, s] / elapsed, avg_ms(det, s), ms(quantile(det, s, count[det, s], 0.95))
+    }
+    printf "\n  ],\n  \"total_ingest_fps\": %.2f,\n  \"total_dropped_packets\": %d,\n", total_fps, total_drops
+    printf "  \"sustained\": %s", (sustained ? "true" : "false")
+}' "$WORK_DIR/metrics_before.txt" "$WORK_DIR/metrics_after.txt")
+
+report=$(cat << EOF
+{
+  "hardware": {"cpu_model": "$cpu_model", "cpus": $(nproc), "mem_total_kb": $mem_total_kb, "kernel": "$(uname -r)", "arch": "$(uname -m)"},
+  "load": {"streams": $STREAMS, "size": "$SIZE", "fps": $FPS, "bitrate": "$BITRATE", "gop_seconds": $GOP, "codec": "$CODEC", "input": "${SOURCE_FILE:-testsrc2}", "model": "${MODEL:-none}", "warmup_seconds": $WARMUP, "duration_seconds": $elapsed},
+  "process": {"cpu_percent": $cpu_percent, "rss_kb_avg": $((rss_sum / samples)), "rss_kb_max": $rss_max, "threads": $threads},
+  "streams": [
+$streams_json
+}
+EOF
+)
+
+if [ -n "$OUTPUT" ]; then
+    echo "$report" > "$OUTPUT"
+    log "Report written to $OUTPUT"
+else
+    echo "$report"
+fi
@@ -11,11 +11,65 @@
 #include "ini.h"
 #include "core/config.h"
 #include "core/logger.h"
+#include "utils/memory.h"
 #include "database/database_manager.h"
 
 // Global configuration variable
 config_t g_config;
 
+// Stream configurations shared by every config_t loaded in this process.
+// Allocated once, when the first configuration is loaded, with max_streams
+// entries and never moved afterwards, because the stream threads keep
+// pointers into it. Changing max_streams therefore requires a restart.
+static stream_config_t *stream_storage = NULL;
+static int stream_storage_capacity = 0;
+
+// max_streams value to save until the restart that applies it, 0 if none
+static int requested_max_streams = 0;
+
+// Default values for one stream configuration
+static void load_default_stream_config(stream_config_t *stream) {
+    memset(stream, 0, sizeof(stream_config_t));
+    stream->detection_based_recording = false;
+    stream->detection_model[0] = '\0';
+    stream->detection_interval = 10; // Check every 10 frames
+    stream->detection_threshold = 0.5f; // 50% confidence threshold
+    stream->detection_frame_step = 0; // Decode key frames only
+    stream->detection_url[0] = '\0'; // Detect on the main stream
+    stream->detection_motion_gate = MOTION_GATE_OFF; // Detect on every sampled frame
+    stream->detection_zones[0] = '\0'; // Detect in the whole frame
+    stream->motion_mask[0] = '\0'; // Detect motion in the whole frame
+    stream->pre_detection_buffer = 5; // 5 seconds before detection
+    stream->post_detection_buffer = 10; // 10 seconds after detection
+    stream->streaming_enabled = true; // Enable streaming by default
+    stream->record_audio = false; // Disable audio recording by default
+}
+
+// Allocate the stream configurations once max_streams is known
+static int allocate_stream_storage(config_t *config) {
+    if (!stream_storage) {
+        stream_storage = calloc(config->max_streams, sizeof(stream_config_t));
+        if (!stream_storage) {
+            log_error("Failed to allocate configuration for %d streams", config->max_streams);
+            return -1;
+        }
+        stream_storage_capacity = config->max_streams;
+
+        for (int i = 0; i < stream_storage_capacity; i++) {
+            load_default_stream_config(&stream_storage[i]);
+        }
+        log_info("Allocated configuration for %d streams", stream_storage_capacity);
+    } else if (config->max_streams != stream_storage_capacity) {
+        log_warn("Max streams change %d -> %d requires restart to take effect",
+                 stream_storage_capacity, config->max_streams);
+        requested_max_streams = config->max_streams;
+        config->max_streams = stream_storage_capacity;
+    }
+
+    config->streams = stream_storage;
+    return 0;
+}
+
 // Default configuration values
 void load_default_config(config_t *config) {
     if (!config) return;
@@ -27,22 +81,87 @@ void load_default_config(config_t *config) {
     snprintf(config->pid_file, MAX_PATH_LENGTH, "/var/run/lightnvr.pid");
     snprintf(config->log_file, MAX_PATH_LENGTH, "/var/log/lightnvr.log");
     config->log_level = LOG_LEVEL_INFO;
+    config->log_async = true;
     
     // Storage settings
     snprintf(config->storage_path, MAX_PATH_LENGTH, "/var/lib/lightnvr/recordings");
     config->storage_path_hls[0] = '\0'; // Empty by default, will use storage_path if not specified
+    config->hls_memory_store = false;
+    config->hls_recording = false;
+    config->hls_low_latency = false;
+    config->hls_part_duration_ms = 333;
+    config->hls_on_demand = false;
+    config->hls_idle_timeout = 30;
+    config->hls_abr_renditions[0] = '\0';
+    config->hls_mosaic_streams[0] = '\0';
+    snprintf(config->hls_mosaic_name, sizeof(config->hls_mosaic_name), "mosaic");
+    config->hls_mosaic_fps = 2;
+    config->hls_mosaic_height = 720;
     config->max_storage_size = 0; // 0 means unlimited
     config->retention_days = 30;
     config->auto_delete_oldest = true;
+    config->min_free_percent = 5;
+    config->target_free_percent = 10;
+    config->retention_priority_hours = 0;
+    config->archive_path[0] = '\0'; // No secondary storage
+    config->archive_after_hours = 24;
+    config->archive_rate_kbps = 20480; // 20 MiB/s
+    config->compact_clip_seconds = 0; // No compaction
+    config->compact_after_hours = 2;
+    config->thin_after_days = 0; // Keep every frame until retention_days
+    config->storage_volumes[0] = '\0'; // Only the MP4 storage path
+    snprintf(config->volume_placement, sizeof(config->volume_placement), "round_robin");
+    config->volume_pins[0] = '\0';
+    config->storage_latency_slow_ms = 1000;
+    config->storage_latency_critical_ms = 5000;
+    config->mp4_fragmented = false;
+    config->mp4_standby = true;
+    config->shard_recordings = true;
+    config->recording_thumbnails = true;
+    config->thumbnail_sprite_interval = 0;
     
     // Models settings
     snprintf(config->models_path, MAX_PATH_LENGTH, "/var/lib/lightnvr/models");
+    config->detection_workers = 0;
+    config->detection_max_fps = 0;
+    config->detection_batch_size = 8;
+    config->detection_batch_window_ms = 50;
+    config->detection_adaptive_interval = false;
+    config->motion_vectors = false;
+    config->packet_activity_gate = false;
+    config->detection_interval_min = 0;
+    config->detection_interval_max = 30;
+    config->tflite_threads = 0;
+    snprintf(config->tflite_delegate, sizeof(config->tflite_delegate), "xnnpack");
+    config->tflite_warmup = true;
+    config->model_memory_budget = 0;
+    config->model_idle_timeout = 0;
+    config->sod_opencl = false;
     
     // API detection settings
     snprintf(config->api_detection_url, MAX_URL_LENGTH, "http://localhost:8000/detect");
+    config->api_detection_jpeg_quality = 85;
+    config->api_detection_max_inflight = 2;
+    config->remote_detection_timeout_ms = 2000;
+    config->remote_detection_jpeg_quality = 85;
+    config->frame_export_enabled = false;
+    config->frame_export_streams[0] = '\0';
+    config->frame_export_size = 640;
+    config->frame_export_slots = 4;
+
+    // Load shedding settings
+    config->load_shedding_enabled = true;
+    config->load_shed_cpu_high = 90;
+    config->load_shed_cpu_low = 70;
+    config->load_shed_memory_high = 90;
+    config->load_shed_memory_low = 80;
+    config->load_shed_pause_priority = 5;
     
     // Database settings
     snprintf(config->db_path, MAX_PATH_LENGTH, "/var/lib/lightnvr/lightnvr.db");
+    config->db_compact_detections = false;
+    config->db_partition_by_day = false;
+    config->db_slow_query_ms = 500;
     
     // Web server settings
     config->web_port = 8080;
@@ -51,6 +170,18 @@ void load_default_config(config_t *config) {
     snprintf(config->web_username, 32, "admin");
     snprintf(config->web_password, 32, "admin"); // Default password, should be changed
     config->webrtc_disabled = false; // WebRTC is enabled by default
+    config->web_thread_pool_size = 8;
+    config->web_request_queue_size = 64;
+    config->web_route_max_concurrency = 4;
+    config->web_event_loops = 1;
+    config->web_max_connections = 256;
+    config->web_max_connections_per_ip = 32;
+    config->web_header_timeout = 15;
+    config->web_idle_timeout = 60;
+    config->web_send_buffer_kb = 256;
+    config->mjpeg_fps = 2;
+    config->mjpeg_width = 640;
+    config->mjpeg_max_clients = 32;
     
     // Web optimization settings
     config->web_compression_enabled = true;
@@ -63,33 +194,64 @@ void load_default_config(config_t *config) {
     config->web_cache_max_age_default = 86400;    // 1 day default
     
     // Stream settings
-    config->max_streams = 16;
+    config->max_streams = DEFAULT_MAX_STREAMS;
+
+    // Shared ingest settings
+    config->shared_ingest_enabled = true;
+    config->ingest_queue_depth = 0; // Device profile
+    config->ingest_gop_cache = true;
+    config->udp_buffer_size = 16384; // 16MB
+    config->udp_reorder_queue_size = 1000;
+    config->udp_fifo_size = 16384; // 16MB
+    config->startup_concurrency = 4;
     
     // Memory optimization
     config->buffer_size = 1024; // 1MB buffer size
     config->use_swap = true;
     snprintf(config->swap_file, MAX_PATH_LENGTH, "/var/lib/lightnvr/swap");
     config->swap_size = 128 * 1024 * 1024; // 128MB swap
+    config->memory_budget_mb = MEMORY_BUDGET_DEFAULT_MB;
+    snprintf(config->device_profile, sizeof(config->device_profile), "auto");
+    config->db_cache_kb = 0;
+    config->db_mmap_mb = -1;
+    config->storage_cache_ttl = 0;
+    config->log_buffer_entries = 0;
+
+    // Thread scheduling: any CPU, default priority
+    memset(config->thread_sched, 0, sizeof(config->thread_sched));
     
     // Hardware acceleration
     config->hw_accel_enabled = false;
     memset(config->hw_accel_device, 0, 32);
+    config->transcode_hevc = true;
+    config->transcode_max_software = 2;
     
     // go2rtc settings
     snprintf(config->go2rtc_binary_path, MAX_PATH_LENGTH, "/usr/local/bin/go2rtc");
     snprintf(config->go2rtc_config_dir, MAX_PATH_LENGTH, "/etc/lightnvr/go2rtc");
     config->go2rtc_api_port = 1984;
+    config->go2rtc_upstream = false;
+
+    // Federation settings
+    config->federation_enabled = false;
+    snprintf(config->federation_node_name, sizeof(config->federation_node_name), "local");
+    config->federation_peers[0] = '\0';
+    config->federation_auth[0] = '\0';
+    config->federation_timeout_ms = 3000;
+    config->federation_cache_ttl = 5;
+
+    // Upload settings
+    config->upload_url[0] = '\0';
+    config->upload_auth[0] = '\0';
+    config->upload_s3_region[0] = '\0';
+    config->upload_rate_kbps = 256;
+    config->upload_max_attempts = 12;
     
     // Initialize default values for detection-based recording in streams
-    for (int i = 0; i < MAX_STREAMS; i++) {
-        config->streams[i].detection_based_recording = false;
-        config->streams[i].detection_model[0] = '\0';
-        config->streams[i].detection_interval = 10; // Check every 10 frames
-        config->streams[i].detection_threshold = 0.5f; // 50% confidence threshold
-        config->streams[i].pre_detection_buffer = 5; // 5 seconds before detection
-        config->streams[i].post_detection_buffer = 10; // 10 seconds after detection
-        config->streams[i].streaming_enabled = true; // Enable streaming by default
-        config->streams[i].record_audio = false; // Disable audio recording by default
+    // (no storage yet on the first load, it is allocated once max_streams is parsed)
+    config->streams = stream_storage;
+    for (int i = 0; i < stream_storage_capacity; i++) {
+        load_default_stream_config(&config->streams[i]);
     }
 }
 
@@ -234,6 +396,26 @@ int validate_config(const config_t *config) {
         return -1;
     }
     
+    // Check web worker pool
+    if (config->web_thread_pool_size <= 0 || config->web_request_queue_size <= 0) {
+        log_error("Invalid web worker pool: %d threads, queue of %d",
+                  config->web_thread_pool_size, config->web_request_queue_size);
+        return -1;
+    }
+    
+    // Check ingest queue depth
+    if (config->ingest_queue_depth < 0) {
+        log_error("Invalid ingest queue depth: %d", config->ingest_queue_depth);
+        return -1;
+    }
+    
+    // Check UDP ingest buffers
+    if (config->udp_buffer_size <= 0 || config->udp_fifo_size <= 0 || config->udp_reorder_queue_size < 0) {
+        log_error("Invalid UDP ingest buffers: buffer %d KB, FIFO %d KB, reorder queue %d packets",
+                  config->udp_buffer_size, config->udp_fifo_size, config->udp_reorder_queue_size);
+        return -1;
+    }
+
     // Check buffer size
     if (config->buffer_size <= 0) {
         log_error("Invalid buffer size: %d", config->buffer_size);
@@ -261,6 +443,8 @@ static int config_ini_handler(void* user, const char* section, const char* name,
             strncpy(config->log_file, value, MAX_PATH_LENGTH - 1);
         } else if (strcmp(name, "log_level") == 0) {
             config->log_level = atoi(value);
+        } else if (strcmp(name, "log_async") == 0) {
+            config->log_async = (strcmp(value, "true") == 0 || strcmp(value, "1") == 0);
         }
     }
     // Storage settings
@@ -269,30 +453,237 @@ static int config_ini_handler(void* user, const char* section, const char* name,
             strncpy(config->storage_path, value, MAX_PATH_LENGTH - 1);
         } else if (strcmp(name, "path_hls") == 0) {
             strncpy(config->storage_path_hls, value, MAX_PATH_LENGTH - 1);
+        } else if (strcmp(name, "hls_memory_store") == 0) {
+            config->hls_memory_store = (strcmp(value, "true") == 0 || strcmp(value, "1") == 0);
+        } else if (strcmp(name, "hls_recording") == 0) {
+            config->hls_recording = (strcmp(value, "true") == 0 || strcmp(value, "1") == 0);
+        } else if (strcmp(name, "hls_low_latency") == 0) {
+            config->hls_low_latency = (strcmp(value, "true") == 0 || strcmp(value, "1") == 0);
+        } else if (strcmp(name, "hls_part_duration") == 0) {
+            config->hls_part_duration_ms = atoi(value);
+            if (config->hls_part_duration_ms < 200) {
+                config->hls_part_duration_ms = 200;
+            } else if (config->hls_part_duration_ms > 500) {
+                config->hls_part_duration_ms = 500;
+            }
+        } else if (strcmp(name, "hls_on_demand") == 0) {
+            config->hls_on_demand = (strcmp(value, "true") == 0 || strcmp(value, "1") == 0);
+        } else if (strcmp(name, "hls_idle_timeout") == 0) {
+            config->hls_idle_timeout = atoi(value);
+            if (config->hls_idle_timeout < 5) {
+                config->hls_idle_timeout = 5;
+            }
+        } else if (strcmp(name, "hls_abr_renditions") == 0) {
+            strncpy(config->hls_abr_renditions, value, sizeof(config->hls_abr_renditions) - 1);
+            config->hls_abr_renditions[sizeof(config->hls_abr_renditions) - 1] = '\0';
+        } else if (strcmp(name, "hls_mosaic_streams") == 0) {
+            strncpy(config->hls_mosaic_streams, value, sizeof(config->hls_mosaic_streams) - 1);
+            config->hls_mosaic_streams[sizeof(config->hls_mosaic_streams) - 1] = '\0';
+        } else if (strcmp(name, "hls_mosaic_name") == 0) {
+            if (value[0] != '\0' && !strchr(value, '/')) {
+                strncpy(config->hls_mosaic_name, value, sizeof(config->hls_mosaic_name) - 1);
+                config->hls_mosaic_name[sizeof(config->hls_mosaic_name) - 1] = '\0';
+            }
+        } else if (strcmp(name, "hls_mosaic_fps") == 0) {
+            config->hls_mosaic_fps = atoi(value);
+            if (config->hls_mosaic_fps < 1) {
+                config->hls_mosaic_fps = 1;
+            } else if (config->hls_mosaic_fps > 15) {
+                config->hls_mosaic_fps = 15;
+            }
+        } else if (strcmp(name, "hls_mosaic_height") == 0) {
+            config->hls_mosaic_height = atoi(value);
+            if (config->hls_mosaic_height < 360) {
+                config->hls_mosaic_height = 360;
+            } else if (config->hls_mosaic_height > 2160) {
+                config->hls_mosaic_height = 2160;
+            }
         } else if (strcmp(name, "max_size") == 0) {
             config->max_storage_size = strtoull(value, NULL, 10);
         } else if (strcmp(name, "retention_days") == 0) {
             config->retention_days = atoi(value);
         } else if (strcmp(name, "auto_delete_oldest") == 0) {
             config->auto_delete_oldest = (strcmp(value, "true") == 0 || strcmp(value, "1") == 0);
+        } else if (strcmp(name, "min_free_percent") == 0) {
+            config->min_free_percent = atoi(value);
+            if (config->min_free_percent < 0) {
+                config->min_free_percent = 0;
+            } else if (config->min_free_percent > 50) {
+                config->min_free_percent = 50;
+            }
+        } else if (strcmp(name, "target_free_percent") == 0) {
+            config->target_free_percent = atoi(value);
+            if (config->target_free_percent < 0) {
+                config->target_free_percent = 0;
+            } else if (config->target_free_percent > 60) {
+                config->target_free_percent = 60;
+            }
+        } else if (strcmp(name, "retention_priority_hours") == 0) {
+            config->retention_priority_hours = atoi(value);
+            if (config->retention_priority_hours < 0) {
+                config->retention_priority_hours = 0;
+            }
+        } else if (strcmp(name, "archive_path") == 0) {
+            strncpy(config->archive_path, value, MAX_PATH_LENGTH - 1);
+            config->archive_path[MAX_PATH_LENGTH - 1] = '\0';
+        } else if (strcmp(name, "archive_after_hours") == 0) {
+            config->archive_after_hours = atoi(value);
+            if (config->archive_after_hours < 1) {
+                config->archive_after_hours = 1;
+            }
+        } else if (strcmp(name, "archive_rate_kbps") == 0) {
+            config->archive_rate_kbps = atoi(value);
+            if (config->archive_rate_kbps < 0) {
+                config->archive_rate_kbps = 0;
+            }
+        } else if (strcmp(name, "compact_clip_seconds") == 0) {
+            config->compact_clip_seconds = atoi(value);
+            if (config->compact_clip_seconds < 0) {
+                config->compact_clip_seconds = 0;
+            }
+        } else if (strcmp(name, "compact_after_hours") == 0) {
+            config->compact_after_hours = atoi(value);
+            if (config->compact_after_hours < 1) {
+                config->compact_after_hours = 1;
+            }
+        } else if (strcmp(name, "thin_after_days") == 0) {
+            config->thin_after_days = atoi(value);
+            if (config->thin_after_days < 0) {
+                config->thin_after_days = 0;
+            }
+        } else if (strcmp(name, "volumes") == 0) {
+            strncpy(config->storage_volumes, value, sizeof(config->storage_volumes) - 1);
+            config->storage_volumes[sizeof(config->storage_volumes) - 1] = '\0';
+        } else if (strcmp(name, "volume_placement") == 0) {
+            if (strcmp(value, "round_robin") == 0 || strcmp(value, "free_space") == 0 ||
+                strcmp(value, "pinned") == 0) {
+                snprintf(config->volume_placement, sizeof(config->volume_placement), "%s", value);
+            } else {
+                log_warn("Unknown volume_placement %s, using round_robin", value);
+                snprintf(config->volume_placement, sizeof(config->volume_placement), "round_robin");
+            }
+        } else if (strcmp(name, "volume_pins") == 0) {
+            strncpy(config->volume_pins, value, sizeof(config->volume_pins) - 1);
+            config->volume_pins[sizeof(config->volume_pins) - 1] = '\0';
+        } else if (strcmp(name, "latency_slow_ms") == 0) {
+            config->storage_latency_slow_ms = atoi(value);
+            if (config->storage_latency_slow_ms < 0) {
+                config->storage_latency_slow_ms = 0;
+            }
+        } else if (strcmp(name, "latency_critical_ms") == 0) {
+            config->storage_latency_critical_ms = atoi(value);
+            if (config->storage_latency_critical_ms < 0) {
+                config->storage_latency_critical_ms = 0;
+            }
+        } else if (strcmp(name, "mp4_fragmented") == 0) {
+            config->mp4_fragmented = (strcmp(value, "true") == 0 || strcmp(value, "1") == 0);
+        } else if (strcmp(name, "mp4_standby") == 0) {
+            config->mp4_standby = (strcmp(value, "true") == 0 || strcmp(value, "1") == 0);
+        } else if (strcmp(name, "shard_recordings") == 0) {
+            config->shard_recordings = (strcmp(value, "true") == 0 || strcmp(value, "1") == 0);
+        } else if (strcmp(name, "recording_thumbnails") == 0) {
+            config->recording_thumbnails = (strcmp(value, "true") == 0 || strcmp(value, "1") == 0);
+        } else if (strcmp(name, "thumbnail_sprite_interval") == 0) {
+            config->thumbnail_sprite_interval = atoi(value);
+            if (config->thumbnail_sprite_interval < 0) {
+                config->thumbnail_sprite_interval = 0;
+            }
         }
     }
     // Models settings
     else if (strcmp(section, "models") == 0) {
         if (strcmp(name, "path") == 0) {
             strncpy(config->models_path, value, MAX_PATH_LENGTH - 1);
+        } else if (strcmp(name, "detection_workers") == 0) {
+            config->detection_workers = atoi(value);
+        } else if (strcmp(name, "detection_max_fps") == 0) {
+            config->detection_max_fps = atoi(value);
+        } else if (strcmp(name, "detection_batch_size") == 0) {
+            config->detection_batch_size = atoi(value);
+        } else if (strcmp(name, "detection_batch_window_ms") == 0) {
+            config->detection_batch_window_ms = atoi(value);
+        } else if (strcmp(name, "detection_adaptive_interval") == 0) {
+            config->detection_adaptive_interval = (strcmp(value, "true") == 0 || strcmp(value, "1") == 0);
+        } else if (strcmp(name, "motion_vectors") == 0) {
+            config->motion_vectors = (strcmp(value, "true") == 0 || strcmp(value, "1") == 0);
+        } else if (strcmp(name, "packet_activity_gate") == 0) {
+            config->packet_activity_gate = (strcmp(value, "true") == 0 || strcmp(value, "1") == 0);
+        } else if (strcmp(name, "detection_interval_min") == 0) {
+            config->detection_interval_min = atoi(value);
+        } else if (strcmp(name, "detection_interval_max") == 0) {
+            config->detection_interval_max = atoi(value);
+        } else if (strcmp(name, "tflite_threads") == 0) {
+            config->tflite_threads = atoi(value);
+        } else if (strcmp(name, "tflite_delegate") == 0) {
+            strncpy(config->tflite_delegate, value, sizeof(config->tflite_delegate) - 1);
+            config->tflite_delegate[sizeof(config->tflite_delegate) - 1] = '\0';
+        } else if (strcmp(name, "tflite_warmup") == 0) {
+            config->tflite_warmup = (strcmp(value, "true") == 0 || strcmp(value, "1") == 0);
+        } else if (strcmp(name, "model_memory_budget") == 0) {
+            config->model_memory_budget = atoi(value);
+        } else if (strcmp(name, "model_idle_timeout") == 0) {
+            config->model_idle_timeout = atoi(value);
+        } else if (strcmp(name, "sod_opencl") == 0) {
+            config->sod_opencl = (strcmp(value, "true") == 0 || strcmp(value, "1") == 0);
         }
     }
     // API detection settings
     else if (strcmp(section, "api_detection") == 0) {
         if (strcmp(name, "url") == 0) {
             strncpy(config->api_detection_url, value, MAX_URL_LENGTH - 1);
+        } else if (strcmp(name, "jpeg_quality") == 0) {
+            config->api_detection_jpeg_quality = atoi(value);
+        } else if (strcmp(name, "max_inflight") == 0) {
+            config->api_detection_max_inflight = atoi(value);
+        }
+    }
+    // Remote inference settings
+    else if (strcmp(section, "remote_detection") == 0) {
+        if (strcmp(name, "timeout_ms") == 0) {
+            config->remote_detection_timeout_ms = atoi(value);
+        } else if (strcmp(name, "jpeg_quality") == 0) {
+            config->remote_detection_jpeg_quality = atoi(value);
+        }
+    }
+    // Shared-memory frame export settings
+    else if (strcmp(section, "frame_export") == 0) {
+        if (strcmp(name, "enabled") == 0) {
+            config->frame_export_enabled = (strcmp(value, "true") == 0 || strcmp(value, "1") == 0);
+        } else if (strcmp(name, "streams") == 0) {
+            strncpy(config->frame_export_streams, value, sizeof(config->frame_export_streams) - 1);
+            config->frame_export_streams[sizeof(config->frame_export_streams) - 1] = '\0';
+        } else if (strcmp(name, "size") == 0) {
+            config->frame_export_size = atoi(value);
+        } else if (strcmp(name, "slots") == 0) {
+            config->frame_export_slots = atoi(value);
+        }
+    }
+    // Load shedding settings
+    else if (strcmp(section, "load_shedding") == 0) {
+        if (strcmp(name, "enabled") == 0) {
+            config->load_shedding_enabled = (strcmp(value, "true") == 0 || strcmp(value, "1") == 0);
+        } else if (strcmp(name, "cpu_high") == 0) {
+            config->load_shed_cpu_high = atoi(value);
+        } else if (strcmp(name, "cpu_low") == 0) {
+            config->load_shed_cpu_low = atoi(value);
+        } else if (strcmp(name, "memory_high") == 0) {
+            config->load_shed_memory_high = atoi(value);
+        } else if (strcmp(name, "memory_low") == 0) {
+            config->load_shed_memory_low = atoi(value);
+        } else if (strcmp(name, "pause_priority") == 0) {
+            config->load_shed_pause_priority = atoi(value);
         }
     }
     // Database settings
     else if (strcmp(section, "database") == 0) {
         if (strcmp(name, "path") == 0) {
             strncpy(config->db_path, value, MAX_PATH_LENGTH - 1);
+        } else if (strcmp(name, "compact_detections") == 0) {
+            config->db_compact_detections = (strcmp(value, "true") == 0 || strcmp(value, "1") == 0);
+        } else if (strcmp(name, "partition_by_day") == 0) {
+            config->db_partition_by_day = (strcmp(value, "true") == 0 || strcmp(value, "1") == 0);
+        } else if (strcmp(name, "slow_query_ms") == 0) {
+            config->db_slow_query_ms = atoi(value);
         }
     }
     // Web server settings
@@ -309,12 +700,95 @@ static int config_ini_handler(void* user, const char* section, const char* name,
             strncpy(config->web_password, value, 31);
         } else if (strcmp(name, "webrtc_disabled") == 0) {
             config->webrtc_disabled = (strcmp(value, "true") == 0 || strcmp(value, "1") == 0);
+        } else if (strcmp(name, "web_thread_pool_size") == 0) {
+            config->web_thread_pool_size = atoi(value);
+        } else if (strcmp(name, "web_request_queue_size") == 0) {
+            config->web_request_queue_size = atoi(value);
+        } else if (strcmp(name, "web_route_max_concurrency") == 0) {
+            config->web_route_max_concurrency = atoi(value);
+            if (config->web_route_max_concurrency < 0) {
+                config->web_route_max_concurrency = 0;
+            }
+        } else if (strcmp(name, "web_event_loops") == 0) {
+            config->web_event_loops = atoi(value);
+            if (config->web_event_loops < 1) {
+                config->web_event_loops = 1;
+            } else if (config->web_event_loops > MAX_WEB_EVENT_LOOPS) {
+                config->web_event_loops = MAX_WEB_EVENT_LOOPS;
+            }
+        } else if (strcmp(name, "web_max_connections") == 0) {
+            config->web_max_connections = atoi(value);
+            if (config->web_max_connections < 0) {
+                config->web_max_connections = 0;
+            }
+        } else if (strcmp(name, "web_max_connections_per_ip") == 0) {
+            config->web_max_connections_per_ip = atoi(value);
+            if (config->web_max_connections_per_ip < 0) {
+                config->web_max_connections_per_ip = 0;
+            }
+        } else if (strcmp(name, "web_header_timeout") == 0) {
+            config->web_header_timeout = atoi(value);
+            if (config->web_header_timeout < 0) {
+                config->web_header_timeout = 0;
+            }
+        } else if (strcmp(name, "web_idle_timeout") == 0) {
+            config->web_idle_timeout = atoi(value);
+            if (config->web_idle_timeout < 0) {
+                config->web_idle_timeout = 0;
+            }
+        } else if (strcmp(name, "web_send_buffer_kb") == 0) {
+            config->web_send_buffer_kb = atoi(value);
+            if (config->web_send_buffer_kb < 16) {
+                config->web_send_buffer_kb = 16;
+            } else if (config->web_send_buffer_kb > 16384) {
+                config->web_send_buffer_kb = 16384;
+            }
+        } else if (strcmp(name, "mjpeg_fps") == 0) {
+            config->mjpeg_fps = atoi(value);
+            if (config->mjpeg_fps < 1) {
+                config->mjpeg_fps = 1;
+            } else if (config->mjpeg_fps > 10) {
+                config->mjpeg_fps = 10;
+            }
+        } else if (strcmp(name, "mjpeg_width") == 0) {
+            config->mjpeg_width = atoi(value);
+            if (config->mjpeg_width < 0) {
+                config->mjpeg_width = 0;
+            } else if (config->mjpeg_width > 3840) {
+                config->mjpeg_width = 3840;
+            }
+        } else if (strcmp(name, "mjpeg_max_clients") == 0) {
+            config->mjpeg_max_clients = atoi(value);
+            if (config->mjpeg_max_clients < 0) {
+                config->mjpeg_max_clients = 0;
+            } else if (config->mjpeg_max_clients > MAX_MJPEG_CLIENTS) {
+                config->mjpeg_max_clients = MAX_MJPEG_CLIENTS;
+            }
         }
     }
     // Stream settings
     else if (strcmp(section, "streams") == 0) {
         if (strcmp(name, "max_streams") == 0) {
             config->max_streams = atoi(value);
+        } else if (strcmp(name, "shared_ingest") == 0) {
+            config->shared_ingest_enabled = (strcmp(value, "true") == 0 || strcmp(value, "1") == 0);
+        } else if (strcmp(name, "ingest_queue_depth") == 0) {
+            config->ingest_queue_depth = atoi(value);
+        } else if (strcmp(name, "ingest_gop_cache") == 0) {
+            config->ingest_gop_cache = (strcmp(value, "true") == 0 || strcmp(value, "1") == 0);
+        } else if (strcmp(name, "udp_buffer_size") == 0) {
+            config->udp_buffer_size = atoi(value);
+        } else if (strcmp(name, "udp_reorder_queue_size") == 0) {
+            config->udp_reorder_queue_size = atoi(value);
+        } else if (strcmp(name, "udp_fifo_size") == 0) {
+            config->udp_fifo_size = atoi(value);
+        } else if (strcmp(name, "startup_concurrency") == 0) {
+            config->startup_concurrency = atoi(value);
+            if (config->startup_concurrency < 1) {
+                config->startup_concurrency = 1;
+            } else if (config->startup_concurrency > 16) {
+                config->startup_concurrency = 16;
+            }
         }
     }
     // Stream-specific settings (format: stream_name.setting)
@@ -324,7 +798,7 @@ static int config_ini_handler(void* user, const char* section, const char* name,
         
         // Find the stream with this name
         int stream_idx = -1;
-        for (int i = 0; i < config->max_streams; i++) {
+        for (int i = 0; config->streams && i < config->max_streams && i < stream_storage_capacity; i++) {
             if (strcmp(config->streams[i].name, stream_name) == 0) {
                 stream_idx = i;
                 break;
@@ -347,6 +821,21 @@ static int config_ini_handler(void* user, const char* section, const char* name,
             config->streams[stream_idx].detection_interval = atoi(value);
         } else if (strcmp(name, "detection_threshold") == 0) {
             config->streams[stream_idx].detection_threshold = atof(value);
+        } else if (strcmp(name, "detection_frame_step") == 0) {
+            config->streams[stream_idx].detection_frame_step = atoi(value);
+        } else if (strcmp(name, "detection_url") == 0) {
+            strncpy(config->streams[stream_idx].detection_url, value, MAX_URL_LENGTH - 1);
+            config->streams[stream_idx].detection_url[MAX_URL_LENGTH - 1] = '\0';
+        } else if (strcmp(name, "detection_motion_gate") == 0) {
+            int gate = atoi(value);
+            config->streams[stream_idx].detection_motion_gate =
+                (gate >= MOTION_GATE_OFF && gate <= MOTION_GATE_REGION) ? (motion_gate_t)gate : MOTION_GATE_OFF;
+        } else if (strcmp(name, "detection_zones") == 0) {
+            strncpy(config->streams[stream_idx].detection_zones, value, MAX_DETECTION_ZONES_TEXT - 1);
+            config->streams[stream_idx].detection_zones[MAX_DETECTION_ZONES_TEXT - 1] = '\0';
+        } else if (strcmp(name, "motion_mask") == 0) {
+            strncpy(config->streams[stream_idx].motion_mask, value, MAX_MOTION_MASK_TEXT - 1);
+            config->streams[stream_idx].motion_mask[MAX_MOTION_MASK_TEXT - 1] = '\0';
         } else if (strcmp(name, "pre_detection_buffer") == 0) {
             config->streams[stream_idx].pre_detection_buffer = atoi(value);
         } else if (strcmp(name, "post_detection_buffer") == 0) {
@@ -354,6 +843,15 @@ static int config_ini_handler(void* user, const char* section, const char* name,
         } else if (strcmp(name, "record_audio") == 0) {
             config->streams[stream_idx].record_audio = 
                 (strcmp(value, "true") == 0 || strcmp(value, "1") == 0);
+        } else if (strcmp(name, "retention_days") == 0) {
+            int days = atoi(value);
+            config->streams[stream_idx].retention_days = days > 0 ? days : 0;
+        } else if (strcmp(name, "max_storage_size") == 0) {
+            config->streams[stream_idx].max_storage_bytes = strtoull(value, NULL, 10);
+        } else if (strcmp(name, "retention_class") == 0) {
+            config->streams[stream_idx].retention_class = parse_retention_class(value);
+        } else if (strcmp(name, "hls_segment_format") == 0) {
+            config->streams[stream_idx].hls_segment_format = parse_hls_segment_format(value);
         }
     }
     // Memory optimization
@@ -366,6 +864,69 @@ static int config_ini_handler(void* user, const char* section, const char* name,
             strncpy(config->swap_file, value, MAX_PATH_LENGTH - 1);
         } else if (strcmp(name, "swap_size") == 0) {
             config->swap_size = strtoull(value, NULL, 10);
+        } else if (strcmp(name, "budget_mb") == 0) {
+            config->memory_budget_mb = strcmp(value, "auto") == 0 ? -1 : atoi(value);
+            if (config->memory_budget_mb < -1) {
+                config->memory_budget_mb = 0;
+            }
+        } else if (strcmp(name, "profile") == 0) {
+            if (strcmp(value, "small") == 0 || strcmp(value, "medium") == 0 || strcmp(value, "large") == 0) {
+                snprintf(config->device_profile, sizeof(config->device_profile), "%s", value);
+            } else {
+                snprintf(config->device_profile, sizeof(config->device_profile), "auto");
+            }
+        } else if (strcmp(name, "db_cache_kb") == 0) {
+            config->db_cache_kb = strcmp(value, "auto") == 0 ? 0 : atoi(value);
+            if (config->db_cache_kb < 0) {
+                config->db_cache_kb = 0;
+            }
+        } else if (strcmp(name, "db_mmap_mb") == 0) {
+            config->db_mmap_mb = strcmp(value, "auto") == 0 ? -1 : atoi(value);
+            if (config->db_mmap_mb < -1) {
+                config->db_mmap_mb = 0;
+            }
+        } else if (strcmp(name, "storage_cache_ttl") == 0) {
+            config->storage_cache_ttl = strcmp(value, "auto") == 0 ? 0 : atoi(value);
+            if (config->storage_cache_ttl < 0) {
+                config->storage_cache_ttl = 0;
+            }
+        } else if (strcmp(name, "log_buffer_entries") == 0) {
+            config->log_buffer_entries = strcmp(value, "auto") == 0 ? 0 : atoi(value);
+            if (config->log_buffer_entries < 0) {
+                config->log_buffer_entries = 0;
+            }
+        }
+    }
+    // Thread scheduling, keys are <class>_cpus, <class>_nice and <class>_policy
+    else if (strcmp(section, "threads") == 0) {
+        for (int i = 0; i < THREAD_CLASS_COUNT; i++) {
+            const char *class_name = thread_class_name((thread_class_t)i);
+            size_t len = strlen(class_name);
+            if (strncmp(name, class_name, len) != 0 || name[len] != '_') {
+                continue;
+            }
+
+            thread_sched_config_t *sched = &config->thread_sched[i];
+            const char *key = name + len + 1;
+            if (strcmp(key, "cpus") == 0) {
+                strncpy(sched->cpus, value, sizeof(sched->cpus) - 1);
+            } else if (strcmp(key, "nice") == 0) {
+                sched->nice = atoi(value);
+                if (sched->nice < -20) {
+                    sched->nice = -20;
+                } else if (sched->nice > 19) {
+                    sched->nice = 19;
+                }
+            } else if (strcmp(key, "policy") == 0) {
+                if (strcmp(value, "idle") == 0) {
+                    sched->policy = THREAD_POLICY_IDLE;
+                } else if (strcmp(value, "batch") == 0) {
+                    sched->policy = THREAD_POLICY_BATCH;
+                } else {
+                    sched->policy = THREAD_POLICY_NORMAL;
+                }
+            }
+            break;
         }
     }
     // Hardware acceleration
@@ -374,6 +935,13 @@ static int config_ini_handler(void* user, const char* section, const char* name,
             config->hw_accel_enabled = (strcmp(value, "true") == 0 || strcmp(value, "1") == 0);
         } else if (strcmp(name, "hw_accel_device") == 0) {
             strncpy(config->hw_accel_device, value, 31);
+        } else if (strcmp(name, "transcode_hevc") == 0) {
+            config->transcode_hevc = (strcmp(value, "true") == 0 || strcmp(value, "1") == 0);
+        } else if (strcmp(name, "transcode_max_software") == 0) {
+            config->transcode_max_software = atoi(value);
+            if (config->transcode_max_software < 0) {
+                config->transcode_max_software = 0;
+            }
         }
     }
     // go2rtc settings
@@ -384,6 +952,56 @@ static int config_ini_handler(void* user, const char* section, const char* name,
             strncpy(config->go2rtc_config_dir, value, MAX_PATH_LENGTH - 1);
         } else if (strcmp(name, "api_port") == 0) {
             config->go2rtc_api_port = atoi(value);
+        } else if (strcmp(name, "upstream") == 0) {
+            config->go2rtc_upstream = (strcmp(value, "true") == 0 || strcmp(value, "1") == 0);
+        }
+    }
+    // Federation settings
+    else if (strcmp(section, "federation") == 0) {
+        if (strcmp(name, "enabled") == 0) {
+            config->federation_enabled = (strcmp(value, "true") == 0 || strcmp(value, "1") == 0);
+        } else if (strcmp(name, "node_name") == 0) {
+            strncpy(config->federation_node_name, value, sizeof(config->federation_node_name) - 1);
+            config->federation_node_name[sizeof(config->federation_node_name) - 1] = '\0';
+        } else if (strcmp(name, "peers") == 0) {
+            strncpy(config->federation_peers, value, sizeof(config->federation_peers) - 1);
+            config->federation_peers[sizeof(config->federation_peers) - 1] = '\0';
+        } else if (strcmp(name, "auth") == 0) {
+            strncpy(config->federation_auth, value, sizeof(config->federation_auth) - 1);
+            config->federation_auth[sizeof(config->federation_auth) - 1] = '\0';
+        } else if (strcmp(name, "timeout_ms") == 0) {
+            config->federation_timeout_ms = atoi(value);
+            if (config->federation_timeout_ms < 100) {
+                config->federation_timeout_ms = 100;
+            }
+        } else if (strcmp(name, "cache_ttl") == 0) {
+            config->federation_cache_ttl = atoi(value);
+            if (config->federation_cache_ttl < 0) {
+                config->federation_cache_ttl = 0;
+            }
+        }
+    }
+    // Upload settings
+    else if (strcmp(section, "upload") == 0) {
+        if (strcmp(name, "url") == 0) {
+            strncpy(config->upload_url, value, sizeof(config->upload_url) - 1);
+            config->upload_url[sizeof(config->upload_url) - 1] = '\0';
+        } else if (strcmp(name, "auth") == 0) {
+            strncpy(config->upload_auth, value, sizeof(config->upload_auth) - 1);
+            config->upload_auth[sizeof(config->upload_auth) - 1] = '\0';
+        } else if (strcmp(name, "s3_region") == 0) {
+            strncpy(config->upload_s3_region, value, sizeof(config->upload_s3_region) - 1);
+            config->upload_s3_region[sizeof(config->upload_s3_region) - 1] = '\0';
+        } else if (strcmp(name, "rate_kbps") == 0) {
+            config->upload_rate_kbps = atoi(value);
+            if (config->upload_rate_kbps < 0) {
+                config->upload_rate_kbps = 0;
+            }
+        } else if (strcmp(name, "max_attempts") == 0) {
+            config->upload_max_attempts = atoi(value);
+            if (config->upload_max_attempts < 1) {
+                config->upload_max_attempts = 1;
+            }
         }
     }
     
@@ -408,10 +1026,10 @@ static int load_config_from_file(const char *filename, config_t *config) {
 
 // Load stream configurations from database
 int load_stream_configs(config_t *config) {
-    if (!config) return -1;
+    if (!config || !config->streams) return -1;
     
     // Clear existing stream configurations
-    memset(config->streams, 0, sizeof(stream_config_t) * MAX_STREAMS);
+    memset(config->streams, 0, sizeof(stream_config_t) * config->max_streams);
     
     // Get stream count from database
     int count = count_stream_configs();
@@ -426,16 +1044,14 @@ int load_stream_configs(config_t *config) {
     }
     
     // Get stream configurations from database
-    stream_config_t db_streams[MAX_STREAMS];
-    int loaded = get_all_stream_configs(db_streams, MAX_STREAMS);
+    int loaded = get_all_stream_configs(config->streams, config->max_streams);
     if (loaded < 0) {
         log_error("Failed to load stream configurations from database");
         return -1;
     }
     
-    // Copy stream configurations to config
-    for (int i = 0; i < loaded && i < config->max_streams; i++) {
-        memcpy(&config->streams[i], &db_streams[i], sizeof(stream_config_t));
+    if (count > loaded) {
+        log_warn("Database has %d streams but max_streams is %d, ignoring the rest", count, config->max_streams);
     }
     
     log_info("Loaded %d stream configurations from database", loaded);
@@ -478,10 +1094,17 @@ int save_stream_configs(const config_t *config) {
     
     if (count > 0) {
         // Get existing stream names
-        stream_config_t db_streams[MAX_STREAMS];
-        int loaded = get_all_stream_configs(db_streams, MAX_STREAMS);
+        stream_config_t *db_streams = calloc(count, sizeof(stream_config_t));
+        if (!db_streams) {
+            log_error("Failed to allocate memory for stream configurations");
+            rollback_transaction();
+            return -1;
+        }
+        
+        int loaded = get_all_stream_configs(db_streams, count);
         if (loaded < 0) {
             log_error("Failed to load stream configurations from database");
+            free(db_streams);
             rollback_transaction();
             return -1;
         }
@@ -498,6 +1121,7 @@ int save_stream_configs(const config_t *config) {
             
             if (identical) {
                 log_info("Stream configurations unchanged, skipping update");
+                free(db_streams);
                 commit_transaction();
                 return loaded;
             }
@@ -507,14 +1131,17 @@ int save_stream_configs(const config_t *config) {
         for (int i = 0; i < loaded; i++) {
             if (delete_stream_config(db_streams[i].name) != 0) {
                 log_error("Failed to delete stream configuration: %s", db_streams[i].name);
+                free(db_streams);
                 rollback_transaction();
                 return -1;
             }
         }
+        
+        free(db_streams);
     }
     
     // Add stream configurations to database
-    for (int i = 0; i < config->max_streams; i++) {
+    for (int i = 0; config->streams && i < config->max_streams; i++) {
         if (strlen(config->streams[i].name) > 0) {
             uint64_t result = add_stream_config(&config->streams[i]);
             if (result == 0) {
@@ -544,6 +1171,85 @@ static char g_custom_config_path[MAX_PATH_LENGTH] = {0};
 // Global variable to store the actual loaded config path
 static char g_loaded_config_path[MAX_PATH_LENGTH] = {0};
 
+// Function to change max_streams on the next restart
+int request_max_streams(int max_streams) {
+    if (max_streams <= 0 || max_streams > MAX_STREAMS) {
+        log_error("Invalid max streams: %d (must be 1-%d)", max_streams, MAX_STREAMS);
+        return -1;
+    }
+
+    requested_max_streams = (max_streams == stream_storage_capacity) ? 0 : max_streams;
+    return 0;
+}
+
+// Name of a thread class as used in the [threads] section
+const char *thread_class_name(thread_class_t thread_class) {
+    switch (thread_class) {
+        case THREAD_CLASS_INGEST:
+            return "ingest";
+        case THREAD_CLASS_HLS:
+            return "hls";
+        case THREAD_CLASS_RECORDING:
+            return "recording";
+        case THREAD_CLASS_DETECTION:
+            return "detection";
+        case THREAD_CLASS_WEB:
+            return "web";
+        case THREAD_CLASS_SERVICE:
+            return "service";
+        default:
+            return "unknown";
+    }
+}
+
+// Name of a thread policy as written to the configuration
+const char *thread_policy_name(thread_policy_t policy) {
+    switch (policy) {
+        case THREAD_POLICY_BATCH:
+            return "batch";
+        case THREAD_POLICY_IDLE:
+            return "idle";
+        default:
+            return "normal";
+    }
+}
+
+// Parse a stream's hls_segment_format setting
+hls_segment_format_t parse_hls_segment_format(const char *name) {
+    if (name && (strcmp(name, "fmp4") == 0 || strcmp(name, "cmaf") == 0)) {
+        return HLS_SEGMENT_FMP4;
+    }
+    return HLS_SEGMENT_MPEGTS;
+}
+
+// Name of an HLS segment format as written to the configuration
+const char *hls_segment_format_name(hls_segment_format_t format) {
+    return format == HLS_SEGMENT_FMP4 ? "fmp4" : "mpegts";
+}
+
+// Parse a stream's retention_class setting
+retention_class_t parse_retention_class(const char *name) {
+    if (name && strcmp(name, "critical") == 0) {
+        return RETENTION_CLASS_CRITICAL;
+    }
+    if (name && (strcmp(name, "best_effort") == 0 || strcmp(name, "best-effort") == 0)) {
+        return RETENTION_CLASS_BEST_EFFORT;
+    }
+    return RETENTION_CLASS_NORMAL;
+}
+
+// Name of a retention class as written to the configuration
+const char *retention_class_name(retention_class_t retention_class) {
+    switch (retention_class) {
+        case RETENTION_CLASS_CRITICAL:
+            return "critical";
+        case RETENTION_CLASS_BEST_EFFORT:
+            return "best_effort";
+        default:
+            return "normal";
+    }
+}
+
 // Function to set the custom config path
 void set_custom_config_path(const char *path) {
     if (path && path[0] != '\0') {
@@ -679,6 +1385,11 @@ int load_config(config_t *config) {
         return -1;
     }
     
+    // Size the stream configurations to max_streams
+    if (allocate_stream_storage(config) != 0) {
+        return -1;
+    }
+    
     // Ensure directories exist
     if (ensure_directories(config) != 0) {
         log_error("Failed to create required directories");
@@ -714,6 +1425,7 @@ int reload_config(config_t *config) {
     // Log changes
     if (old_config.log_level != config->log_level) {
         log_info("Log level changed: %d -> %d", old_config.log_level, config->log_level);
+        set_log_level(config->log_level);
     }
     
     if (old_config.web_port != config->web_port) {
@@ -819,7 +1531,9 @@ int save_config(const config_t *config, const char *path) {
     fprintf(file, "[general]\n");
     fprintf(file, "pid_file = %s\n", config->pid_file);
     fprintf(file, "log_file = %s\n", config->log_file);
-    fprintf(file, "log_level = %d  ; 0=ERROR, 1=WARN, 2=INFO, 3=DEBUG\n\n", config->log_level);
+    fprintf(file, "log_level = %d  ; 0=ERROR, 1=WARN, 2=INFO, 3=DEBUG\n", config->log_level);
+    fprintf(file, "log_async = %s  ; Write log lines from a background thread in batches\n\n",
+            config->log_async ? "true" : "false");
     
     // Write storage settings
     fprintf(file, "[storage]\n");
@@ -829,22 +1543,145 @@ int save_config(const config_t *config, const char *path) {
     if (config->storage_path_hls[0] != '\0') {
         fprintf(file, "path_hls = %s  ; Dedicated path for HLS segments\n", config->storage_path_hls);
     }
+    fprintf(file, "hls_memory_store = %s  ; Keep live HLS segments in memory\n",
+            config->hls_memory_store ? "true" : "false");
+    fprintf(file, "hls_recording = %s  ; Keep fMP4 HLS segments as the recording\n",
+            config->hls_recording ? "true" : "false");
+    fprintf(file, "hls_low_latency = %s  ; Publish Low-Latency HLS with partial segments\n",
+            config->hls_low_latency ? "true" : "false");
+    fprintf(file, "hls_part_duration = %d  ; LL-HLS part duration in milliseconds (200-500)\n",
+            config->hls_part_duration_ms);
+    fprintf(file, "hls_on_demand = %s  ; Only write live HLS while it is being watched\n",
+            config->hls_on_demand ? "true" : "false");
+    fprintf(file, "hls_idle_timeout = %d  ; Seconds without viewers before on-demand HLS stops\n",
+            config->hls_idle_timeout);
+    fprintf(file, "hls_abr_renditions = %s  ; Heights of transcoded HLS renditions, e.g. 720,360\n",
+            config->hls_abr_renditions);
+    fprintf(file, "hls_mosaic_streams = %s  ; Streams tiled into one mosaic stream, * for all\n",
+            config->hls_mosaic_streams);
+    fprintf(file, "hls_mosaic_name = %s  ; Served at /hls/<name>/index.m3u8\n", config->hls_mosaic_name);
+    fprintf(file, "hls_mosaic_fps = %d  ; Mosaic frame rate (1-15)\n", config->hls_mosaic_fps);
+    fprintf(file, "hls_mosaic_height = %d  ; Mosaic height (360-2160), 16:9\n", config->hls_mosaic_height);
     
     fprintf(file, "max_size = %llu  ; 0 means unlimited, otherwise bytes\n", (unsigned long long)config->max_storage_size);
     fprintf(file, "retention_days = %d\n", config->retention_days);
-    fprintf(file, "auto_delete_oldest = %s\n\n", config->auto_delete_oldest ? "true" : "false");
+    fprintf(file, "auto_delete_oldest = %s\n", config->auto_delete_oldest ? "true" : "false");
+    fprintf(file, "min_free_percent = %d  ; Delete the oldest recordings below this much free space\n",
+            config->min_free_percent);
+    fprintf(file, "target_free_percent = %d  ; Free space deletion stops at\n", config->target_free_percent);
+    fprintf(file, "retention_priority_hours = %d  ; Hours younger each priority level makes a stream's recordings\n",
+            config->retention_priority_hours);
+    fprintf(file, "archive_path = %s  ; Secondary storage for aged recordings, empty to keep all local\n",
+            config->archive_path);
+    fprintf(file, "archive_after_hours = %d  ; Age at which recordings move to archive_path\n",
+            config->archive_after_hours);
+    fprintf(file, "archive_rate_kbps = %d  ; Copy rate limit in KiB/s, 0 for unlimited\n",
+            config->archive_rate_kbps);
+    fprintf(file, "compact_clip_seconds = %d  ; Compact shorter clips into hourly files, 0 for off\n",
+            config->compact_clip_seconds);
+    fprintf(file, "compact_after_hours = %d  ; Age at which an hour's clips are compacted\n",
+            config->compact_after_hours);
+    fprintf(file, "thin_after_days = %d  ; Keep only key frames of older recordings, 0 for never\n",
+            config->thin_after_days);
+    fprintf(file, "volumes = %s  ; Further recording volumes, comma-separated, one per disk\n",
+            config->storage_volumes);
+    fprintf(file, "volume_placement = %s  ; round_robin, free_space or pinned\n", config->volume_placement);
+    fprintf(file, "volume_pins = %s  ; stream=volume pairs for pinned placement, 0 being the MP4 path\n",
+            config->volume_pins);
+    fprintf(file, "latency_slow_ms = %d  ; p99 write latency at which a disk is rated slow, 0 for off\n",
+            config->storage_latency_slow_ms);
+    fprintf(file, "latency_critical_ms = %d  ; p99 write latency at which a disk is rated critical\n",
+            config->storage_latency_critical_ms);
+    fprintf(file, "mp4_fragmented = %s  ; Fragmented MP4 recordings that survive power loss\n",
+            config->mp4_fragmented ? "true" : "false");
+    fprintf(file, "mp4_standby = %s  ; MP4 output kept ready for detection-triggered recordings\n",
+            config->mp4_standby ? "true" : "false");
+    fprintf(file, "shard_recordings = %s  ; New recordings in <stream>/YYYY/MM/DD/HH directories\n",
+            config->shard_recordings ? "true" : "false");
+    fprintf(file, "recording_thumbnails = %s  ; Thumbnail of each finished recording, made in idle time\n",
+            config->recording_thumbnails ? "true" : "false");
+    fprintf(file, "thumbnail_sprite_interval = %d  ; Seconds between scrub sprite tiles, 0 for no sprites\n\n",
+            config->thumbnail_sprite_interval);
     
     // Write models settings
     fprintf(file, "[models]\n");
-    fprintf(file, "path = %s\n\n", config->models_path);
+    fprintf(file, "path = %s\n", config->models_path);
+    fprintf(file, "detection_workers = %d  ; Threads running detection for all streams (0 = device profile)\n",
+            config->detection_workers);
+    fprintf(file, "detection_max_fps = %d  ; Frames per second detected across all streams (0 = unlimited)\n",
+            config->detection_max_fps);
+    fprintf(file, "detection_batch_size = %d  ; Frames of different streams a SOD model runs at once (1 = no batching)\n",
+            config->detection_batch_size);
+    fprintf(file, "detection_batch_window_ms = %d  ; How long a batch waits for frames of other streams\n",
+            config->detection_batch_window_ms);
+    fprintf(file, "detection_adaptive_interval = %s  ; Check quiet streams less often\n",
+            config->detection_adaptive_interval ? "true" : "false");
+    fprintf(file, "detection_interval_min = %d  ; Seconds between checks while active (0 = stream's detection_interval)\n",
+            config->detection_interval_min);
+    fprintf(file, "detection_interval_max = %d  ; Seconds between checks of a quiet stream\n",
+            config->detection_interval_max);
+    fprintf(file, "motion_vectors = %s  ; Motion gates of H.264 streams read motion vectors instead of pixels\n",
+            config->motion_vectors ? "true" : "false");
+    fprintf(file, "packet_activity_gate = %s  ; Decode streams for detection only while their packet sizes show activity\n",
+            config->packet_activity_gate ? "true" : "false");
+    fprintf(file, "tflite_threads = %d  ; Interpreter threads per TFLite model (0 = cores divided between the workers)\n",
+            config->tflite_threads);
+    fprintf(file, "tflite_delegate = %s  ; none, xnnpack, nnapi or edgetpu\n", config->tflite_delegate);
+    fprintf(file, "tflite_warmup = %s  ; Run a blank frame through TFLite models when they load\n",
+            config->tflite_warmup ? "true" : "false");
+    fprintf(file, "model_memory_budget = %d  ; MB of loaded models, least recently used unloaded first (0 = no limit)\n",
+            config->model_memory_budget);
+    fprintf(file, "model_idle_timeout = %d  ; Seconds a model may go unused before it is unloaded (0 = never)\n",
+            config->model_idle_timeout);
+    fprintf(file, "sod_opencl = %s  ; Run SOD models on the GPU through OpenCL when available\n\n",
+            config->sod_opencl ? "true" : "false");
     
     // Write API detection settings
     fprintf(file, "[api_detection]\n");
-    fprintf(file, "url = %s\n\n", config->api_detection_url);
+    fprintf(file, "url = %s\n", config->api_detection_url);
+    fprintf(file, "jpeg_quality = %d  ; JPEG quality of the frames sent to the API (1-100)\n",
+            config->api_detection_jpeg_quality);
+    fprintf(file, "max_inflight = %d  ; Requests one stream may have out at once\n\n",
+            config->api_detection_max_inflight);
+
+    // Write remote inference settings
+    fprintf(file, "[remote_detection]\n");
+    fprintf(file, "timeout_ms = %d  ; How long a detection waits for the inference server\n",
+            config->remote_detection_timeout_ms);
+    fprintf(file, "jpeg_quality = %d  ; JPEG quality of the frames sent to the inference server (1-100)\n\n",
+            config->remote_detection_jpeg_quality);
+
+    // Write shared-memory frame export settings
+    fprintf(file, "[frame_export]\n");
+    fprintf(file, "enabled = %s  ; Publish decoded detection frames in shared memory\n",
+            config->frame_export_enabled ? "true" : "false");
+    fprintf(file, "streams = %s  ; Comma-separated streams to export, empty for all\n",
+            config->frame_export_streams);
+    fprintf(file, "size = %d  ; Largest width/height of an exported frame\n",
+            config->frame_export_size);
+    fprintf(file, "slots = %d  ; Frames kept in each stream's ring\n\n",
+            config->frame_export_slots);
+
+    // Write load shedding settings
+    fprintf(file, "[load_shedding]\n");
+    fprintf(file, "enabled = %s  ; Shed detection work while CPU or memory stays high\n",
+            config->load_shedding_enabled ? "true" : "false");
+    fprintf(file, "cpu_high = %d  ; CPU percent at which more work is shed\n", config->load_shed_cpu_high);
+    fprintf(file, "cpu_low = %d  ; CPU percent below which shedding is undone\n", config->load_shed_cpu_low);
+    fprintf(file, "memory_high = %d  ; Memory percent at which more work is shed\n", config->load_shed_memory_high);
+    fprintf(file, "memory_low = %d  ; Memory percent below which shedding is undone\n", config->load_shed_memory_low);
+    fprintf(file, "pause_priority = %d  ; Streams below this priority pause detection at the last step\n\n",
+            config->load_shed_pause_priority);
     
     // Write database settings
     fprintf(file, "[database]\n");
-    fprintf(file, "path = %s\n\n", config->db_path);
+    fprintf(file, "path = %s\n", config->db_path);
+    fprintf(file, "compact_detections = %s  ; Store detections as per-minute blobs of quantized boxes\n",
+            config->db_compact_detections ? "true" : "false");
+    fprintf(file, "partition_by_day = %s  ; One detections and events table per day, retention drops whole days\n",
+            config->db_partition_by_day ? "true" : "false");
+    fprintf(file, "slow_query_ms = %d  ; Log statements running longer, with their query plan (0 = off)\n\n",
+            config->db_slow_query_ms);
     
     // Write web server settings
     fprintf(file, "[web]\n");
@@ -854,34 +1691,129 @@ int save_config(const config_t *config, const char *path) {
     fprintf(file, "username = %s\n", config->web_username);
     fprintf(file, "password = %s  ; IMPORTANT: Change this default password!\n", config->web_password);
     fprintf(file, "webrtc_disabled = %s\n", config->webrtc_disabled ? "true" : "false");
+    fprintf(file, "web_thread_pool_size = %d  ; Worker threads for API requests\n", config->web_thread_pool_size);
+    fprintf(file, "web_request_queue_size = %d  ; Requests waiting for a worker before new ones get 503\n",
+            config->web_request_queue_size);
+    fprintf(file, "web_route_max_concurrency = %d  ; Workers one API route may occupy (0 = no limit)\n",
+            config->web_route_max_concurrency);
+    fprintf(file, "web_event_loops = %d  ; Event loops accepting connections (SO_REUSEPORT when > 1)\n",
+            config->web_event_loops);
+    fprintf(file, "web_max_connections = %d  ; Open connections across all event loops (0 = no limit)\n",
+            config->web_max_connections);
+    fprintf(file, "web_max_connections_per_ip = %d  ; Open connections of one client address (0 = no limit)\n",
+            config->web_max_connections_per_ip);
+    fprintf(file, "web_header_timeout = %d  ; Seconds a new connection has to send its request headers\n",
+            config->web_header_timeout);
+    fprintf(file, "web_idle_timeout = %d  ; Seconds without reads or writes before a connection is closed\n",
+            config->web_idle_timeout);
+    fprintf(file, "web_send_buffer_kb = %d  ; KiB queued per connection before its response waits\n",
+            config->web_send_buffer_kb);
+    fprintf(file, "mjpeg_fps = %d  ; Frames per second of live MJPEG streams (1-10)\n", config->mjpeg_fps);
+    fprintf(file, "mjpeg_width = %d  ; Width of live MJPEG frames (0 = the stream's own)\n", config->mjpeg_width);
+    fprintf(file, "mjpeg_max_clients = %d  ; Live MJPEG connections across all streams (0 = disabled)\n",
+            config->mjpeg_max_clients);
     fprintf(file, "\n");
     
     // Write stream settings
     fprintf(file, "[streams]\n");
-    fprintf(file, "max_streams = %d\n\n", config->max_streams);
+    fprintf(file, "max_streams = %d\n", requested_max_streams > 0 ? requested_max_streams : config->max_streams);
+    fprintf(file, "shared_ingest = %s  ; Demux each camera once for HLS, MP4 and detection\n",
+            config->shared_ingest_enabled ? "true" : "false");
+    fprintf(file, "ingest_queue_depth = %d  ; Packets queued per consumer (0 = device profile)\n",
+            config->ingest_queue_depth);
+    fprintf(file, "ingest_gop_cache = %s  ; Keep the newest GOP so live view starts at once\n",
+            config->ingest_gop_cache ? "true" : "false");
+    fprintf(file, "udp_buffer_size = %d  ; Socket receive buffer of UDP inputs in KB\n", config->udp_buffer_size);
+    fprintf(file, "udp_reorder_queue_size = %d  ; RTP packets held to reorder UDP input\n",
+            config->udp_reorder_queue_size);
+    fprintf(file, "udp_fifo_size = %d  ; Reader thread buffer of udp:// inputs in KB\n", config->udp_fifo_size);
+    fprintf(file, "startup_concurrency = %d  ; Streams connected at once after startup\n\n", config->startup_concurrency);
     
     // Write memory optimization settings
     fprintf(file, "[memory]\n");
     fprintf(file, "buffer_size = %d  ; Buffer size in KB\n", config->buffer_size);
     fprintf(file, "use_swap = %s\n", config->use_swap ? "true" : "false");
     fprintf(file, "swap_file = %s\n", config->swap_file);
-    fprintf(file, "swap_size = %llu  ; Size in bytes\n\n", (unsigned long long)config->swap_size);
+    fprintf(file, "swap_size = %llu  ; Size in bytes\n", (unsigned long long)config->swap_size);
+    if (config->memory_budget_mb < 0) {
+        fprintf(file, "budget_mb = auto  ; Skip optional work above this much tracked memory (0 = no budget)\n");
+    } else {
+        fprintf(file, "budget_mb = %d  ; Skip optional work above this much tracked memory (0 = no budget)\n",
+                config->memory_budget_mb);
+    }
+    fprintf(file, "profile = %s  ; Device tier sizing the settings below: auto, small, medium or large\n",
+            config->device_profile);
+    fprintf(file, "db_cache_kb = %d  ; SQLite page cache in KiB (0 = device profile)\n", config->db_cache_kb);
+    if (config->db_mmap_mb < 0) {
+        fprintf(file, "db_mmap_mb = auto  ; SQLite memory-mapped I/O in MiB (0 = off)\n");
+    } else {
+        fprintf(file, "db_mmap_mb = %d  ; SQLite memory-mapped I/O in MiB (0 = off)\n", config->db_mmap_mb);
+    }
+    fprintf(file, "storage_cache_ttl = %d  ; Seconds storage usage per stream is cached (0 = device profile)\n",
+            config->storage_cache_ttl);
+    fprintf(file, "log_buffer_entries = %d  ; Recent log entries kept in memory (0 = device profile)\n\n",
+            config->log_buffer_entries);
+
+    // Write thread scheduling settings, only for the classes that were changed
+    fprintf(file, "[threads]\n");
+    fprintf(file, "; <class>_cpus, <class>_nice and <class>_policy (normal, batch or idle) for the classes\n");
+    fprintf(file, "; ingest, hls, recording, detection, web and service\n");
+    for (int i = 0; i < THREAD_CLASS_COUNT; i++) {
+        const thread_sched_config_t *sched = &config->thread_sched[i];
+        const char *class_name = thread_class_name((thread_class_t)i);
+        if (sched->cpus[0] != '\0') {
+            fprintf(file, "%s_cpus = %s\n", class_name, sched->cpus);
+        }
+        if (sched->nice != 0) {
+            fprintf(file, "%s_nice = %d\n", class_name, sched->nice);
+        }
+        if (sched->policy != THREAD_POLICY_NORMAL) {
+            fprintf(file, "%s_policy = %s\n", class_name, thread_policy_name(sched->policy));
+        }
+    }
+    fprintf(file, "\n");
     
     // Write hardware acceleration settings
     fprintf(file, "[hardware]\n");
     fprintf(file, "hw_accel_enabled = %s\n", config->hw_accel_enabled ? "true" : "false");
-    fprintf(file, "hw_accel_device = %s\n\n", config->hw_accel_device);
+    fprintf(file, "hw_accel_device = %s\n", config->hw_accel_device);
+    fprintf(file, "transcode_hevc = %s  ; Serve HEVC as H.264 to browsers that cannot play it\n",
+            config->transcode_hevc ? "true" : "false");
+    fprintf(file, "transcode_max_software = %d  ; Software H.264 encoders at once, 0 for hardware only\n\n",
+            config->transcode_max_software);
     
     // Write go2rtc settings
     fprintf(file, "[go2rtc]\n");
     fprintf(file, "binary_path = %s\n", config->go2rtc_binary_path);
     fprintf(file, "config_dir = %s\n", config->go2rtc_config_dir);
     fprintf(file, "api_port = %d\n", config->go2rtc_api_port);
+    fprintf(file, "upstream = %s\n\n", config->go2rtc_upstream ? "true" : "false");
+
+    // Write federation settings
+    fprintf(file, "[federation]\n");
+    fprintf(file, "enabled = %s  ; Answer /api/federation/* for this node and its peers\n",
+            config->federation_enabled ? "true" : "false");
+    fprintf(file, "node_name = %s\n", config->federation_node_name);
+    fprintf(file, "peers = %s  ; Comma-separated name=url of the peer nodes\n", config->federation_peers);
+    fprintf(file, "auth = %s  ; user:password the peers are asked with\n", config->federation_auth);
+    fprintf(file, "timeout_ms = %d  ; How long a peer may take to answer\n", config->federation_timeout_ms);
+    fprintf(file, "cache_ttl = %d  ; Seconds a peer's response is reused\n\n", config->federation_cache_ttl);
+
+    // Write upload settings
+    fprintf(file, "[upload]\n");
+    fprintf(file, "url = %s  ; Base URL event clips are uploaded to, empty for none\n", config->upload_url);
+    fprintf(file, "auth = %s  ; user:password, or access_key:secret_key with s3_region\n", config->upload_auth);
+    fprintf(file, "s3_region = %s  ; Sign requests for S3 in this region\n", config->upload_s3_region);
+    fprintf(file, "rate_kbps = %d  ; Upload rate limit in KiB/s, 0 for unlimited\n", config->upload_rate_kbps);
+    fprintf(file, "max_attempts = %d  ; Attempts before a clip is given up\n", config->upload_max_attempts);
     
     // Write stream-specific settings
-    for (int i = 0; i < config->max_streams; i++) {
+    for (int i = 0; config->streams && i < config->max_streams; i++) {
         if (strlen(config->streams[i].name) > 0 && 
-            (config->streams[i].detection_based_recording || config->streams[i].record_audio)) {
+            (config->streams[i].detection_based_recording || config->streams[i].record_audio ||
+             config->streams[i].retention_days > 0 || config->streams[i].max_storage_bytes > 0 ||
+             config->streams[i].retention_class != RETENTION_CLASS_NORMAL ||
+             config->streams[i].hls_segment_format != HLS_SEGMENT_MPEGTS)) {
             fprintf(file, "\n[stream.%s]\n", config->streams[i].name);
             
             // Write detection-based recording settings if enabled
@@ -895,12 +1827,42 @@ int save_config(const config_t *config, const char *path) {
                 
                 fprintf(file, "detection_interval = %d\n", config->streams[i].detection_interval);
                 fprintf(file, "detection_threshold = %.2f\n", config->streams[i].detection_threshold);
+                fprintf(file, "detection_frame_step = %d\n", config->streams[i].detection_frame_step);
+                if (config->streams[i].detection_url[0] != '\0') {
+                    fprintf(file, "detection_url = %s\n", config->streams[i].detection_url);
+                }
+                if (config->streams[i].detection_motion_gate != MOTION_GATE_OFF) {
+                    fprintf(file, "detection_motion_gate = %d  ; 1 = frames with motion, 2 = moving region only\n",
+                            (int)config->streams[i].detection_motion_gate);
+                }
+                if (config->streams[i].detection_zones[0] != '\0') {
+                    fprintf(file, "detection_zones = %s\n", config->streams[i].detection_zones);
+                }
+                if (config->streams[i].motion_mask[0] != '\0') {
+                    fprintf(file, "motion_mask = %s\n", config->streams[i].motion_mask);
+                }
                 fprintf(file, "pre_detection_buffer = %d\n", config->streams[i].pre_detection_buffer);
                 fprintf(file, "post_detection_buffer = %d\n", config->streams[i].post_detection_buffer);
             }
             
             // Write audio recording setting
             fprintf(file, "record_audio = %s\n", config->streams[i].record_audio ? "true" : "false");
+
+            // Write per-stream retention settings if set
+            if (config->streams[i].retention_days > 0) {
+                fprintf(file, "retention_days = %d\n", config->streams[i].retention_days);
+            }
+            if (config->streams[i].max_storage_bytes > 0) {
+                fprintf(file, "max_storage_size = %llu  ; bytes\n",
+                        (unsigned long long)config->streams[i].max_storage_bytes);
+            }
+            if (config->streams[i].retention_class != RETENTION_CLASS_NORMAL) {
+                fprintf(file, "retention_class = %s\n", retention_class_name(config->streams[i].retention_class));
+            }
+            if (config->streams[i].hls_segment_format != HLS_SEGMENT_MPEGTS) {
+                fprintf(file, "hls_segment_format = %s\n",
+                        hls_segment_format_name(config->streams[i].hls_segment_format));
+            }
         }
     }
     
@@ -925,24 +1887,110 @@ void print_config(const config_t *config) {
     printf("    PID File: %s\n", config->pid_file);
     printf("    Log File: %s\n", config->log_file);
     printf("    Log Level: %d\n", config->log_level);
+    printf("    Async Logging: %s\n", config->log_async ? "true" : "false");
     
     printf("  Storage Settings:\n");
     printf("    Storage Path: %s\n", config->storage_path);
     if (config->storage_path_hls[0] != '\0') {
         printf("    HLS Storage Path: %s\n", config->storage_path_hls);
     }
+    printf("    HLS Memory Store: %s\n", config->hls_memory_store ? "true" : "false");
+    printf("    HLS Recording: %s\n", config->hls_recording ? "true" : "false");
+    printf("    HLS Low Latency: %s", config->hls_low_latency ? "true" : "false");
+    if (config->hls_low_latency) {
+        printf(" (%d ms parts)", config->hls_part_duration_ms);
+    }
+    printf("\n");
+    printf("    HLS On Demand: %s", config->hls_on_demand ? "true" : "false");
+    if (config->hls_on_demand) {
+        printf(" (%d s idle timeout)", config->hls_idle_timeout);
+    }
+    printf("\n");
+    printf("    HLS ABR Renditions: %s\n",
+           config->hls_abr_renditions[0] ? config->hls_abr_renditions : "none");
+    if (config->hls_mosaic_streams[0]) {
+        printf("    HLS Mosaic: %s as %s (%dp, %d fps)\n", config->hls_mosaic_streams, config->hls_mosaic_name,
+               config->hls_mosaic_height, config->hls_mosaic_fps);
+    } else {
+        printf("    HLS Mosaic: none\n");
+    }
     printf("    Max Storage Size: %llu bytes\n", (unsigned long long)config->max_storage_size);
     printf("    Retention Days: %d\n", config->retention_days);
     printf("    Auto Delete Oldest: %s\n", config->auto_delete_oldest ? "true" : "false");
+    printf("    Free Space: delete below %d%%, up to %d%%\n", config->min_free_percent,
+           config->target_free_percent);
+    printf("    Retention Priority Hours: %d\n", config->retention_priority_hours);
+    if (config->archive_path[0] != '\0') {
+        printf("    Archive: %s after %d hours, up to %d KiB/s\n", config->archive_path,
+               config->archive_after_hours, config->archive_rate_kbps);
+    }
+    if (config->compact_clip_seconds > 0) {
+        printf("    Compaction: clips under %d seconds after %d hours\n", config->compact_clip_seconds,
+               config->compact_after_hours);
+    }
+    if (config->thin_after_days > 0) {
+        printf("    Thinning: key frames only after %d days\n", config->thin_after_days);
+    }
+    if (config->storage_volumes[0] != '\0') {
+        printf("    Recording Volumes: %s (%s)\n", config->storage_volumes, config->volume_placement);
+    }
+    if (config->storage_latency_slow_ms > 0) {
+        printf("    Storage Latency Slow/Critical: %d/%d ms\n",
+               config->storage_latency_slow_ms, config->storage_latency_critical_ms);
+    }
+    printf("    Fragmented MP4: %s\n", config->mp4_fragmented ? "true" : "false");
+    printf("    MP4 Standby Outputs: %s\n", config->mp4_standby ? "true" : "false");
+    printf("    Sharded Recordings: %s\n", config->shard_recordings ? "true" : "false");
+    printf("    Recording Thumbnails: %s", config->recording_thumbnails ? "true" : "false");
+    if (config->recording_thumbnails && config->thumbnail_sprite_interval > 0) {
+        printf(", sprite tile every %d seconds", config->thumbnail_sprite_interval);
+    }
+    printf("\n");
     
     printf("  Models Settings:\n");
     printf("    Models Path: %s\n", config->models_path);
+    printf("    Detection Workers: %d\n", config->detection_workers);
+    printf("    Detection Max FPS: %d\n", config->detection_max_fps);
+    printf("    Detection Batch Size: %d\n", config->detection_batch_size);
+    printf("    Detection Batch Window: %d ms\n", config->detection_batch_window_ms);
+    printf("    Adaptive Detection Interval: %s (%d-%d s)\n",
+           config->detection_adaptive_interval ? "true" : "false",
+           config->detection_interval_min, config->detection_interval_max);
+    printf("    Motion Vectors: %s\n", config->motion_vectors ? "true" : "false");
+    printf("    Packet Activity Gate: %s\n", config->packet_activity_gate ? "true" : "false");
+    printf("    TFLite Threads: %d\n", config->tflite_threads);
+    printf("    TFLite Delegate: %s\n", config->tflite_delegate);
+    printf("    TFLite Warmup: %s\n", config->tflite_warmup ? "true" : "false");
+    printf("    Model Memory Budget: %d MB\n", config->model_memory_budget);
+    printf("    Model Idle Timeout: %d s\n", config->model_idle_timeout);
+    printf("    SOD OpenCL: %s\n", config->sod_opencl ? "true" : "false");
     
     printf("  API Detection Settings:\n");
     printf("    API URL: %s\n", config->api_detection_url);
+    printf("    JPEG Quality: %d\n", config->api_detection_jpeg_quality);
+    printf("    Max In-Flight Requests: %d\n", config->api_detection_max_inflight);
+
+    printf("  Remote Detection Settings:\n");
+    printf("    Timeout: %d ms\n", config->remote_detection_timeout_ms);
+    printf("    JPEG Quality: %d\n", config->remote_detection_jpeg_quality);
+
+    printf("  Frame Export Settings:\n");
+    printf("    Enabled: %s\n", config->frame_export_enabled ? "true" : "false");
+    printf("    Streams: %s\n", config->frame_export_streams[0] ? config->frame_export_streams : "(all)");
+    printf("    Max Size: %d\n", config->frame_export_size);
+    printf("    Slots: %d\n", config->frame_export_slots);
+
+    printf("  Load Shedding Settings:\n");
+    printf("    Enabled: %s\n", config->load_shedding_enabled ? "true" : "false");
+    printf("    CPU High/Low: %d%%/%d%%\n", config->load_shed_cpu_high, config->load_shed_cpu_low);
+    printf("    Memory High/Low: %d%%/%d%%\n", config->load_shed_memory_high, config->load_shed_memory_low);
+    printf("    Pause Below Priority: %d\n", config->load_shed_pause_priority);
     
     printf("  Database Settings:\n");
     printf("    Database Path: %s\n", config->db_path);
+    printf("    Compact Detections: %s\n", config->db_compact_detections ? "true" : "false");
+    printf("    Partition By Day: %s\n", config->db_partition_by_day ? "true" : "false");
+    printf("    Slow Query Threshold: %d ms\n", config->db_slow_query_ms);
     
     printf("  Web Server Settings:\n");
     printf("    Web Port: %d\n", config->web_port);
@@ -951,22 +1999,70 @@ void print_config(const config_t *config) {
     printf("    Web Username: %s\n", config->web_username);
     printf("    Web Password: %s\n", "********");
     printf("    WebRTC Disabled: %s\n", config->webrtc_disabled ? "true" : "false");
+    printf("    Worker Threads: %d (queue %d, per route %d)\n", config->web_thread_pool_size,
+           config->web_request_queue_size, config->web_route_max_concurrency);
+    printf("    Event Loops: %d\n", config->web_event_loops);
+    printf("    Connections: %d (%d per address), header timeout %d s, idle timeout %d s\n",
+           config->web_max_connections, config->web_max_connections_per_ip,
+           config->web_header_timeout, config->web_idle_timeout);
+    printf("    Send Buffer: %d KiB per connection\n", config->web_send_buffer_kb);
+    printf("    Live MJPEG: %d fps, width %d, up to %d clients\n", config->mjpeg_fps,
+           config->mjpeg_width, config->mjpeg_max_clients);
     
     printf("  Stream Settings:\n");
     printf("    Max Streams: %d\n", config->max_streams);
+    printf("    Shared Ingest: %s\n", config->shared_ingest_enabled ? "true" : "false");
+    printf("    Ingest Queue Depth: %d packets\n", config->ingest_queue_depth);
+    printf("    Ingest GOP Cache: %s\n", config->ingest_gop_cache ? "true" : "false");
+    printf("    UDP Buffer Size: %d KB\n", config->udp_buffer_size);
+    printf("    UDP Reorder Queue: %d packets\n", config->udp_reorder_queue_size);
+    printf("    UDP FIFO Size: %d KB\n", config->udp_fifo_size);
+    printf("    Startup Concurrency: %d streams\n", config->startup_concurrency);
     
     printf("  Memory Optimization:\n");
     printf("    Buffer Size: %d KB\n", config->buffer_size);
     printf("    Use Swap: %s\n", config->use_swap ? "true" : "false");
     printf("    Swap File: %s\n", config->swap_file);
     printf("    Swap Size: %llu bytes\n", (unsigned long long)config->swap_size);
+    if (config->memory_budget_mb < 0) {
+        printf("    Memory Budget: auto\n");
+    } else {
+        printf("    Memory Budget: %d MB\n", config->memory_budget_mb);
+    }
+    printf("    Device Profile: %s\n", config->device_profile);
+    printf("    Database Cache: %d KiB (0 = profile)\n", config->db_cache_kb);
+    printf("    Database Memory Map: %d MiB (-1 = profile)\n", config->db_mmap_mb);
+    printf("    Storage Cache TTL: %d seconds (0 = profile)\n", config->storage_cache_ttl);
+    printf("    Log Buffer: %d entries (0 = profile)\n", config->log_buffer_entries);
+
+    printf("  Thread Scheduling:\n");
+    for (int i = 0; i < THREAD_CLASS_COUNT; i++) {
+        const thread_sched_config_t *sched = &config->thread_sched[i];
+        printf("    %s: CPUs %s, nice %d, policy %s\n", thread_class_name((thread_class_t)i),
+               sched->cpus[0] != '\0' ? sched->cpus : "any", sched->nice, thread_policy_name(sched->policy));
+    }
     
     printf("  Hardware Acceleration:\n");
     printf("    HW Accel Enabled: %s\n", config->hw_accel_enabled ? "true" : "false");
     printf("    HW Accel Device: %s\n", config->hw_accel_device);
+    printf("    Transcode HEVC: %s (%d software encoders)\n", config->transcode_hevc ? "true" : "false",
+           config->transcode_max_software);
+
+    printf("  Federation Settings:\n");
+    printf("    Enabled: %s\n", config->federation_enabled ? "true" : "false");
+    printf("    Node Name: %s\n", config->federation_node_name);
+    printf("    Peers: %s\n", config->federation_peers[0] ? config->federation_peers : "(none)");
+    printf("    Peer Timeout: %d ms\n", config->federation_timeout_ms);
+    printf("    Cache TTL: %d s\n", config->federation_cache_ttl);
+
+    printf("  Upload Settings:\n");
+    printf("    URL: %s\n", config->upload_url[0] ? config->upload_url : "(none)");
+    printf("    S3 Region: %s\n", config->upload_s3_region[0] ? config->upload_s3_region : "(none)");
+    printf("    Rate Limit: %d KiB/s\n", config->upload_rate_kbps);
+    printf("    Max Attempts: %d\n", config->upload_max_attempts);
     
     printf("  Stream Configurations:\n");
-    for (int i = 0; i < config->max_streams; i++) {
+    for (int i = 0; config->streams && i < config->max_streams; i++) {
         if (strlen(config->streams[i].name) > 0) {
             printf("    Stream %d:\n", i);
             printf("      Name: %s\n", config->streams[i].name);
@@ -982,12 +2078,24 @@ void print_config(const config_t *config) {
                    config->streams[i].detection_based_recording ? "true" : "false");
             printf("      Record Audio: %s\n",
                    config->streams[i].record_audio ? "true" : "false");
+            printf("      Retention Days: %d\n", config->streams[i].retention_days);
+            printf("      Max Storage Size: %llu bytes\n", (unsigned long long)config->streams[i].max_storage_bytes);
+            printf("      Retention Class: %s\n", retention_class_name(config->streams[i].retention_class));
+            printf("      HLS Segment Format: %s\n", hls_segment_format_name(config->streams[i].hls_segment_format));
             
             if (config->streams[i].detection_based_recording) {
                 printf("      Detection Model: %s\n", 
                        config->streams[i].detection_model[0] ? config->streams[i].detection_model : "None");
                 printf("      Detection Interval: %d frames\n", config->streams[i].detection_interval);
                 printf("      Detection Threshold: %.2f\n", config->streams[i].detection_threshold);
+                if (config->streams[i].detection_frame_step > 0) {
+                    printf("      Detection Sampling: every %d frames\n", config->streams[i].detection_frame_step);
+                } else {
+                    printf("      Detection Sampling: key frames only\n");
+                }
+                if (config->streams[i].detection_url[0] != '\0') {
+                    printf("      Detection Sub-stream: %s\n", config->streams[i].detection_url);
+                }
                 printf("      Pre-detection Buffer: %d seconds\n", config->streams[i].pre_detection_buffer);
                 printf("      Post-detection Buffer: %d seconds\n", config->streams[i].post_detection_buffer);
             }
@@ -0,0 +1,274 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#if defined(__linux__) && (defined(__arm__) || defined(__aarch64__))
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+#include "core/logger.h"
+#include "core/config.h"
+#include "core/device_profile.h"
+
+// Memory below which a device is small or medium
+#define SMALL_DEVICE_BYTES  (1024ULL * 1024 * 1024)
+#define MEDIUM_DEVICE_BYTES (4ULL * 1024 * 1024 * 1024)
+
+// Sizes of a tier
+typedef struct {
+    int budget_eighths;         // Memory budget in eighths of the memory
+    int max_detection_workers;  // 0 = one less than the cores
+    int ingest_queue_depth;
+    int db_cache_kb;
+    int db_mmap_mb;
+    int storage_cache_ttl;
+    int log_buffer_entries;
+} tier_sizes_t;
+
+static const tier_sizes_t tier_sizes[] = {
+    [DEVICE_TIER_SMALL]  = { 5, 1, 128,  2048,   0, 1800,  256 },
+    [DEVICE_TIER_MEDIUM] = { 4, 4, 256,  8192,  64,  900,  512 },
+    [DEVICE_TIER_LARGE]  = { 4, 0, 512, 32768, 256,  300, 1024 },
+};
+
+static const char *const knob_names[DEVICE_KNOB_COUNT] = {
+    [DEVICE_KNOB_MEMORY_BUDGET_MB] = "budget_mb",
+    [DEVICE_KNOB_DETECTION_WORKERS] = "detection_workers",
+    [DEVICE_KNOB_INGEST_QUEUE_DEPTH] = "ingest_queue_depth",
+    [DEVICE_KNOB_DB_CACHE_KB] = "db_cache_kb",
+    [DEVICE_KNOB_DB_MMAP_MB] = "db_mmap_mb",
+    [DEVICE_KNOB_STORAGE_CACHE_TTL] = "storage_cache_ttl",
+    [DEVICE_KNOB_LOG_BUFFER_ENTRIES] = "log_buffer_entries",
+};
+
+static device_profile_t profile;
+static const config_t *profile_config = NULL;
+static pthread_once_t profile_once = PTHREAD_ONCE_INIT;
+
+const char *device_tier_name(device_tier_t tier) {
+    switch (tier) {
+        case DEVICE_TIER_SMALL:  return "small";
+        case DEVICE_TIER_MEDIUM: return "medium";
+        case DEVICE_TIER_LARGE:  return "large";
+        default:                 return "unknown";
+    }
+}
+
+/**
+ * Read a number from a file, such as a cgroup limit
+ *
+ * @return 0 on success, -1 if the file is missing or holds no number ("max")
+ */
+static int read_number_file(const char *path, unsigned long long *value) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        return -1;
+    }
+    int n = fscanf(file, "%llu", value);
+    fclose(file);
+    return n == 1 ? 0 : -1;
+}
+
+/**
+ * Get the memory available to the process
+ * A container's limit counts when it is lower than the physical memory.
+ */
+static uint64_t detect_memory(void) {
+    long pages = sysconf(_SC_PHYS_PAGES);
+    long page_size = sysconf(_SC_PAGE_SIZE);
+    uint64_t memory = (pages > 0 && page_size > 0) ? (uint64_t)pages * (uint64_t)page_size : 0;
+
+    unsigned long long limit;
+    if (read_number_file("/sys/fs/cgroup/memory.max", &limit) == 0 ||
+        read_number_file("/sys/fs/cgroup/memory/memory.limit_in_bytes", &limit) == 0) {
+        if (limit > 0 && (memory == 0 || limit < memory)) {
+            memory = limit;
+        }
+    }
+    return memory;
+}
+
+/**
+ * Get the cores the process may run on
+ * Takes the CPU affinity and a cgroup CPU quota into account.
+ */
+static int detect_cores(void) {
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    int cores = online > 0 ? (int)online : 1;
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        int allowed = CPU_COUNT(&set);
+        if (allowed > 0 && allowed < cores) {
+            cores = allowed;
+        }
+    }
+
+    FILE *file = fopen("/sys/fs/cgroup/cpu.max", "r");
+    if (file) {
+        unsigned long long quota, period;
+        if (fscanf(file, "%llu %llu", &quota, &period) == 2 && period > 0) {
+            int quota_cores = (int)((quota + period - 1) / period);
+            if (quota_cores > 0 && quota_cores < cores) {
+                cores = quota_cores;
+            }
+        }
+        fclose(file);
+    }
+    return cores;
+}
+
+static void add_simd(char *list, size_t size, const char *name) {
+    size_t len = strlen(list);
+    snprintf(list + len, size - len, "%s%s", len > 0 ? "," : "", name);
+}
+
+/**
+ * List the SIMD extensions of the CPU
+ * The detection kernels pick their own implementation; this is for the report.
+ */
+static void detect_simd(char *list, size_t size) {
+    list[0] = '\0';
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) {
+        add_simd(list, size, "sse2");
+    }
+    if (__builtin_cpu_supports("ssse3")) {
+        add_simd(list, size, "ssse3");
+    }
+    if (__builtin_cpu_supports("sse4.2")) {
+        add_simd(list, size, "sse4.2");
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        add_simd(list, size, "avx2");
+    }
+    if (__builtin_cpu_supports("avx512f")) {
+        add_simd(list, size, "avx512f");
+    }
+#elif defined(__linux__) && defined(__aarch64__)
+    unsigned long hwcap = getauxval(AT_HWCAP);
+#ifdef HWCAP_ASIMD
+    if (hwcap & HWCAP_ASIMD) {
+        add_simd(list, size, "neon");
+    }
+#endif
+#ifdef HWCAP_SVE
+    if (hwcap & HWCAP_SVE) {
+        add_simd(list, size, "sve");
+    }
+#endif
+    (void)hwcap;
+#elif defined(__linux__) && defined(__arm__)
+    unsigned long hwcap = getauxval(AT_HWCAP);
+#ifdef HWCAP_NEON
+    if (hwcap & HWCAP_NEON) {
+        add_simd(list, size, "neon");
+    }
+#endif
+    (void)hwcap;
+#endif
+    if (list[0] == '\0') {
+        snprintf(list, size, "none");
+    }
+}
+
+static void set_knob(device_knob_t knob, int profile_value, bool configured, int configured_value) {
+    device_knob_value_t *k = &profile.knobs[knob];
+    k->name = knob_names[knob];
+    k->profile_value = profile_value;
+    k->configured = configured;
+    k->value = configured ? configured_value : profile_value;
+}
+
+static void build_profile(void) {
+    const config_t *config = profile_config ? profile_config : &g_config;
+
+    memset(&profile, 0, sizeof(profile));
+    profile.memory_bytes = detect_memory();
+    profile.cores = detect_cores();
+    detect_simd(profile.simd, sizeof(profile.simd));
+
+    if (strcmp(config->device_profile, "small") == 0) {
+        profile.tier = DEVICE_TIER_SMALL;
+        profile.tier_configured = true;
+    } else if (strcmp(config->device_profile, "medium") == 0) {
+        profile.tier = DEVICE_TIER_MEDIUM;
+        profile.tier_configured = true;
+    } else if (strcmp(config->device_profile, "large") == 0) {
+        profile.tier = DEVICE_TIER_LARGE;
+        profile.tier_configured = true;
+    } else if (profile.memory_bytes > 0 && profile.memory_bytes < SMALL_DEVICE_BYTES) {
+        profile.tier = DEVICE_TIER_SMALL;
+    } else if (profile.memory_bytes > 0 && profile.memory_bytes < MEDIUM_DEVICE_BYTES) {
+        profile.tier = DEVICE_TIER_MEDIUM;
+    } else {
+        profile.tier = DEVICE_TIER_LARGE;
+    }
+
+    const tier_sizes_t *sizes = &tier_sizes[profile.tier];
+
+    int budget_mb = (int)(profile.memory_bytes / (1024 * 1024) * (uint64_t)sizes->budget_eighths / 8);
+    set_knob(DEVICE_KNOB_MEMORY_BUDGET_MB, budget_mb,
+             config->memory_budget_mb >= 0, config->memory_budget_mb);
+
+    int workers = profile.cores > 1 ? profile.cores - 1 : 1;
+    if (sizes->max_detection_workers > 0 && workers > sizes->max_detection_workers) {
+        workers = sizes->max_detection_workers;
+    }
+    set_knob(DEVICE_KNOB_DETECTION_WORKERS, workers,
+             config->detection_workers > 0, config->detection_workers);
+
+    set_knob(DEVICE_KNOB_INGEST_QUEUE_DEPTH, sizes->ingest_queue_depth,
+             config->ingest_queue_depth > 0, config->ingest_queue_depth);
+
+    set_knob(DEVICE_KNOB_DB_CACHE_KB, sizes->db_cache_kb,
+             config->db_cache_kb > 0, config->db_cache_kb);
+
+    // A 32-bit process has no address space to spare for mapping the database
+    int mmap_mb = sizeof(void *) >= 8 ? sizes->db_mmap_mb : 0;
+    set_knob(DEVICE_KNOB_DB_MMAP_MB, mmap_mb,
+             config->db_mmap_mb >= 0, config->db_mmap_mb);
+
+    set_knob(DEVICE_KNOB_STORAGE_CACHE_TTL, sizes->storage_cache_ttl,
+             config->storage_cache_ttl > 0, config->storage_cache_ttl);
+
+    set_knob(DEVICE_KNOB_LOG_BUFFER_ENTRIES, sizes->log_buffer_entries,
+             config->log_buffer_entries > 0, config->log_buffer_entries);
+
+    log_info("Device profile %s%s: %llu MB memory, %d cores, SIMD %s",
+             device_tier_name(profile.tier), profile.tier_configured ? " (configured)" : "",
+             (unsigned long long)(profile.memory_bytes / (1024 * 1024)), profile.cores, profile.simd);
+    for (int i = 0; i < DEVICE_KNOB_COUNT; i++) {
+        const device_knob_value_t *k = &profile.knobs[i];
+        if (k->configured && k->value != k->profile_value) {
+            log_info("Device profile: %s = %d from the configuration (profile: %d)",
+                     k->name, k->value, k->profile_value);
+        }
+    }
+}
+
+void device_profile_init(const config_t *config) {
+    profile_config = config;
+    pthread_once(&profile_once, build_profile);
+}
+
+const device_profile_t *device_profile_get(void) {
+    pthread_once(&profile_once, build_profile);
+    return &profile;
+}
+
+int device_profile_value(device_knob_t knob) {
+    if (knob < 0 || knob >= DEVICE_KNOB_COUNT) {
+        return 0;
+    }
+    return device_profile_get()->knobs[knob].value;
+}
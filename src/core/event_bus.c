@@ -0,0 +1,282 @@
+/**
+ * @file event_bus.c
+ * @brief In-process bus linking what the pipeline detects to what acts on it
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+#include "core/event_bus.h"
+#include "core/logger.h"
+#include "core/metrics.h"
+#include "video/thread_utils.h"
+
+// One event of a ring; sequence tells whose turn the slot is, as in
+// Dmitry Vyukov's bounded queue
+typedef struct {
+    atomic_size_t sequence;
+    bus_event_t event;
+} event_slot_t;
+
+typedef struct {
+    char name[16];
+    uint32_t types;
+    bus_event_handler_t handler;
+    void *ctx;
+
+    event_slot_t *slots;
+    size_t mask;                    // Ring size - 1
+    atomic_size_t enqueue_pos;      // Claimed by producers with compare-and-swap
+    size_t dequeue_pos;             // Only used by the dispatch thread
+
+    sem_t wakeup;
+    atomic_bool running;
+    pthread_t thread;
+
+    metric_t drops;
+    metric_t delay;
+} subscriber_t;
+
+static subscriber_t subscribers[EVENT_BUS_MAX_SUBSCRIBERS];
+
+// Subscribers are only appended, so producers read the count without a lock
+static atomic_int subscriber_count = 0;
+static pthread_mutex_t subscribe_mutex = PTHREAD_MUTEX_INITIALIZER;
+static bool stopped = false;
+
+static const char *type_names[BUS_EVENT_TYPE_COUNT] = {
+    "detection",
+    "motion",
+    "onvif_motion",
+    "recording_finished",
+};
+
+static metric_t type_metrics[BUS_EVENT_TYPE_COUNT];
+static pthread_once_t metrics_once = PTHREAD_ONCE_INIT;
+
+static void register_type_metrics(void) {
+    for (int i = 0; i < BUS_EVENT_TYPE_COUNT; i++) {
+        type_metrics[i] = metrics_counter("lightnvr_events_total", "Events published on the event bus",
+                                          "type", type_names[i], NULL);
+    }
+}
+
+/**
+ * Copy an event into a subscriber's ring
+ *
+ * @return false if the ring is full
+ */
+static bool ring_push(subscriber_t *s, const bus_event_t *event) {
+    size_t pos = atomic_load_explicit(&s->enqueue_pos, memory_order_relaxed);
+    while (true) {
+        event_slot_t *slot = &s->slots[pos & s->mask];
+        size_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&s->enqueue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                slot->event = *event;
+                atomic_store_explicit(&slot->sequence, pos + 1, memory_order_release);
+                return true;
+            }
+            // pos was reloaded by the failed exchange
+        } else if (diff < 0) {
+            // The slot still holds the event from one lap earlier
+            return false;
+        } else {
+            pos = atomic_load_explicit(&s->enqueue_pos, memory_order_relaxed);
+        }
+    }
+}
+
+/**
+ * Take the oldest event out of a subscriber's ring
+ *
+ * @return false if the ring is empty
+ */
+static bool ring_pop(subscriber_t *s, bus_event_t *event) {
+    event_slot_t *slot = &s->slots[s->dequeue_pos & s->mask];
+    size_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+    if ((intptr_t)sequence - (intptr_t)(s->dequeue_pos + 1) < 0) {
+        return false;
+    }
+
+    *event = slot->event;
+    atomic_store_explicit(&slot->sequence, s->dequeue_pos + s->mask + 1, memory_order_release);
+    s->dequeue_pos++;
+    return true;
+}
+
+static void *dispatch_thread(void *arg) {
+    subscriber_t *s = (subscriber_t *)arg;
+    thread_set_identity(THREAD_CLASS_SERVICE, "events", s->name);
+
+    // Copied out of the ring, so producers can reuse the slot while the handler runs
+    bus_event_t *event = malloc(sizeof(bus_event_t));
+    if (!event) {
+        log_error("Failed to allocate event buffer for subscriber %s", s->name);
+        atomic_store(&s->running, false);
+        return NULL;
+    }
+
+    while (true) {
+        while (ring_pop(s, event)) {
+            metrics_observe_since(s->delay, event->published_us);
+            pipeline_trace_set_current(&event->trace);
+            s->handler(event, s->ctx);
+            pipeline_trace_set_current(NULL);
+        }
+
+        // Stopped, and everything published before is handled
+        if (!atomic_load(&s->running)) {
+            break;
+        }
+
+        while (sem_wait(&s->wakeup) != 0 && errno == EINTR) {
+        }
+    }
+
+    free(event);
+    return NULL;
+}
+
+int event_bus_subscribe(const char *name, uint32_t types, int capacity,
+                        bus_event_handler_t handler, void *ctx) {
+    if (!name || !handler || types == 0) {
+        log_error("Invalid parameters for event_bus_subscribe");
+        return -1;
+    }
+
+    pthread_once(&metrics_once, register_type_metrics);
+
+    size_t size = 8;
+    if (capacity <= 0) {
+        capacity = EVENT_BUS_DEFAULT_CAPACITY;
+    }
+    while (size < (size_t)capacity) {
+        size <<= 1;
+    }
+
+    pthread_mutex_lock(&subscribe_mutex);
+
+    int count = atomic_load(&subscriber_count);
+    for (int i = 0; i < count; i++) {
+        if (strncmp(subscribers[i].name, name, sizeof(subscribers[i].name) - 1) == 0) {
+            pthread_mutex_unlock(&subscribe_mutex);
+            return 0;
+        }
+    }
+
+    if (stopped || count >= EVENT_BUS_MAX_SUBSCRIBERS) {
+        log_error("Cannot subscribe %s to the event bus: %s", name,
+                  stopped ? "shut down" : "too many subscribers");
+        pthread_mutex_unlock(&subscribe_mutex);
+        return -1;
+    }
+
+    subscriber_t *s = &subscribers[count];
+    memset(s, 0, sizeof(*s));
+    s->slots = calloc(size, sizeof(event_slot_t));
+    if (!s->slots) {
+        log_error("Failed to allocate event ring for subscriber %s", name);
+        pthread_mutex_unlock(&subscribe_mutex);
+        return -1;
+    }
+    for (size_t i = 0; i < size; i++) {
+        atomic_init(&s->slots[i].sequence, i);
+    }
+
+    snprintf(s->name, sizeof(s->name), "%s", name);
+    s->types = types;
+    s->handler = handler;
+    s->ctx = ctx;
+    s->mask = size - 1;
+    atomic_init(&s->enqueue_pos, 0);
+    s->dequeue_pos = 0;
+    sem_init(&s->wakeup, 0, 0);
+    atomic_init(&s->running, true);
+    s->drops = metrics_counter("lightnvr_event_drops_total",
+                               "Events dropped because the subscriber's ring was full",
+                               "subscriber", s->name, NULL);
+    s->delay = metrics_histogram("lightnvr_event_delay_seconds",
+                                 "Time from publishing an event to its subscriber handling it",
+                                 "subscriber", s->name, NULL);
+
+    if (pthread_create(&s->thread, NULL, dispatch_thread, s) != 0) {
+        log_error("Failed to create dispatch thread for subscriber %s: %s", name, strerror(errno));
+        sem_destroy(&s->wakeup);
+        free(s->slots);
+        s->slots = NULL;
+        pthread_mutex_unlock(&subscribe_mutex);
+        return -1;
+    }
+
+    // Published only once the subscriber is complete
+    atomic_store_explicit(&subscriber_count, count + 1, memory_order_release);
+    pthread_mutex_unlock(&subscribe_mutex);
+
+    log_info("Event bus subscriber %s started with room for %zu events", s->name, size);
+    return 0;
+}
+
+int event_bus_publish(bus_event_t *event) {
+    if (!event || event->type < 0 || event->type >= BUS_EVENT_TYPE_COUNT) {
+        return 0;
+    }
+
+    pthread_once(&metrics_once, register_type_metrics);
+    metrics_add(type_metrics[event->type], 1);
+
+    pipeline_trace_get_current(&event->trace);
+    event->published_us = metrics_now_us();
+
+    int delivered = 0;
+    int count = atomic_load_explicit(&subscriber_count, memory_order_acquire);
+    for (int i = 0; i < count; i++) {
+        subscriber_t *s = &subscribers[i];
+        if (!(s->types & BUS_EVENT_MASK(event->type)) || !atomic_load_explicit(&s->running, memory_order_relaxed)) {
+            continue;
+        }
+
+        if (ring_push(s, event)) {
+            sem_post(&s->wakeup);
+            delivered++;
+        } else {
+            metrics_add(s->drops, 1);
+            log_warn_ratelimited("Event bus subscriber %s is behind, dropped a %s event of stream %s",
+                                 s->name, type_names[event->type], event->stream_name);
+        }
+    }
+    return delivered;
+}
+
+void event_bus_shutdown(void) {
+    pthread_mutex_lock(&subscribe_mutex);
+    if (stopped) {
+        pthread_mutex_unlock(&subscribe_mutex);
+        return;
+    }
+    stopped = true;
+    int count = atomic_load(&subscriber_count);
+    pthread_mutex_unlock(&subscribe_mutex);
+
+    for (int i = 0; i < count; i++) {
+        atomic_store(&subscribers[i].running, false);
+        sem_post(&subscribers[i].wakeup);
+    }
+
+    // Rings and semaphores are kept: producers that read the count may still look at them
+    for (int i = 0; i < count; i++) {
+        pthread_join(subscribers[i].thread, NULL);
+    }
+
+    log_info("Event bus shut down");
+}
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -9,6 +10,9 @@
 #include <sys/types.h>
 #include <errno.h>
 #include <libgen.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <semaphore.h>
 
 #include "core/logger.h"
 #include "core/logger_json.h"
@@ -36,6 +40,296 @@ static const char *log_level_strings[] = {
     "DEBUG"
 };
 
+// Recent log entries, written without a lock. A slot's seq is 0 while it is
+// being written and is checked again after copying, so readers drop entries
+// that changed under them instead of waiting for the writer.
+typedef struct {
+    _Atomic uint64_t seq;
+    log_level_t level;
+    char timestamp[20];
+    char message[LOG_RING_MESSAGE_SIZE];
+} log_ring_slot_t;
+
+static log_ring_slot_t log_ring[LOG_RING_SIZE];
+static _Atomic uint32_t log_ring_slots = LOG_RING_SIZE; // Slots in use
+static _Atomic uint64_t log_ring_head = 0;     // Last sequence number handed out
+static _Atomic uint64_t log_ring_floor = 0;    // Entries up to here were cleared
+
+// Keep a formatted message in the ring
+static void log_ring_write(log_level_t level, const char *timestamp, const char *message) {
+    uint64_t seq = atomic_fetch_add(&log_ring_head, 1) + 1;
+    log_ring_slot_t *slot = &log_ring[seq % atomic_load_explicit(&log_ring_slots, memory_order_relaxed)];
+
+    atomic_store_explicit(&slot->seq, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    slot->level = level;
+    memcpy(slot->timestamp, timestamp, sizeof(slot->timestamp));
+    slot->timestamp[sizeof(slot->timestamp) - 1] = '\0';
+    size_t len = strlen(message);
+    if (len > sizeof(slot->message) - 1) {
+        len = sizeof(slot->message) - 1;
+    }
+    memcpy(slot->message, message, len);
+    slot->message[len] = '\0';
+
+    atomic_store_explicit(&slot->seq, seq, memory_order_release);
+}
+
+int get_recent_logs(uint64_t after_seq, log_level_t max_level, log_entry_t *entries,
+                    int max_entries, uint64_t *last_seq) {
+    uint64_t head = atomic_load(&log_ring_head);
+    uint64_t floor = atomic_load(&log_ring_floor);
+    uint64_t slots = atomic_load(&log_ring_slots);
+    if (last_seq) {
+        *last_seq = head;
+    }
+    if (!entries || max_entries <= 0) {
+        return 0;
+    }
+
+    // A client ahead of the ring saw a previous run of the process
+    if (after_seq > head) {
+        after_seq = 0;
+    }
+
+    // Older entries have been overwritten
+    uint64_t oldest = head > slots ? head - slots + 1 : 1;
+    if (after_seq < floor) {
+        after_seq = floor;
+    }
+    if (after_seq + 1 > oldest) {
+        oldest = after_seq + 1;
+    }
+
+    // Walk back from the newest entry, then put the copies in order
+    int count = 0;
+    for (uint64_t seq = head; seq >= oldest && seq > 0 && count < max_entries; seq--) {
+        log_ring_slot_t *slot = &log_ring[seq % slots];
+        if (atomic_load_explicit(&slot->seq, memory_order_acquire) != seq || slot->level > max_level) {
+            continue;
+        }
+
+        log_entry_t *entry = &entries[count];
+        entry->seq = seq;
+        entry->level = slot->level;
+        memcpy(entry->timestamp, slot->timestamp, sizeof(entry->timestamp));
+        memcpy(entry->message, slot->message, sizeof(entry->message));
+        entry->timestamp[sizeof(entry->timestamp) - 1] = '\0';
+        entry->message[sizeof(entry->message) - 1] = '\0';
+
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&slot->seq, memory_order_relaxed) != seq) {
+            continue;
+        }
+        count++;
+    }
+
+    for (int i = 0; i < count / 2; i++) {
+        log_entry_t tmp = entries[i];
+        entries[i] = entries[count - 1 - i];
+        entries[count - 1 - i] = tmp;
+    }
+
+    return count;
+}
+
+void set_log_buffer_entries(int entries) {
+    if (entries < 16) {
+        entries = 16;
+    }
+    if (entries > LOG_RING_SIZE) {
+        entries = LOG_RING_SIZE;
+    }
+    // Entries written before the change fail the sequence check and are dropped
+    atomic_store(&log_ring_slots, (uint32_t)entries);
+}
+
+void clear_recent_logs(void) {
+    atomic_store(&log_ring_floor, atomic_load(&log_ring_head));
+}
+
+// Lines waiting for the asynchronous logger: a bounded queue many threads
+// push to and only the writer thread pops from. A cell's seq tells whose turn
+// it is: equal to the position when free, one more once filled.
+#define LOG_QUEUE_SIZE 1024
+
+typedef struct {
+    _Atomic uint64_t seq;
+    log_level_t level;
+    char timestamp[20];
+    char iso_timestamp[20];
+    char message[LOG_QUEUE_LINE_SIZE];
+} log_queue_cell_t;
+
+static log_queue_cell_t log_queue[LOG_QUEUE_SIZE];
+static _Atomic uint64_t log_queue_tail = 0;    // Next position to push
+static uint64_t log_queue_head = 0;            // Next position to pop, writer thread only
+static _Atomic int log_async_running = 0;
+static pthread_t log_writer;
+static sem_t log_wakeup;
+
+size_t get_logger_memory_usage(void) {
+    return atomic_load(&log_ring_slots) * sizeof(log_ring_slot_t) + sizeof(log_queue);
+}
+
+// Write a line to the log file and the console, without flushing
+// Must be called with logger.mutex held
+static void write_log_line(log_level_t level, const char *timestamp, const char *message) {
+    if (logger.log_file && logger.log_file != stdout && logger.log_file != stderr) {
+        fprintf(logger.log_file, "[%s] [%s] %s\n", timestamp, log_level_strings[level], message);
+    }
+
+    // Always write to console (tee behavior)
+    // Use stderr for errors, stdout for other levels
+    FILE *console = (level == LOG_LEVEL_ERROR) ? stderr : stdout;
+    fprintf(console, "[%s] [%s] %s\n", timestamp, log_level_strings[level], message);
+}
+
+// Flush the log file and the console
+// Must be called with logger.mutex held
+static void flush_log_lines(void) {
+    if (logger.log_file && logger.log_file != stdout && logger.log_file != stderr) {
+        fflush(logger.log_file);
+    }
+    fflush(stdout);
+    fflush(stderr);
+}
+
+// Queue a line for the writer thread, false if it has to be written directly
+// Sets *wake when the writer should not wait for its timer
+static bool log_queue_push(bool *wake, log_level_t level, const char *timestamp, const char *iso_timestamp,
+                           const char *message) {
+    size_t len = strlen(message);
+    if (len >= LOG_QUEUE_LINE_SIZE) {
+        return false;
+    }
+
+    uint64_t pos = atomic_load_explicit(&log_queue_tail, memory_order_relaxed);
+    log_queue_cell_t *cell;
+    for (;;) {
+        cell = &log_queue[pos % LOG_QUEUE_SIZE];
+        uint64_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        int64_t diff = (int64_t)(seq - pos);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&log_queue_tail, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // Full: the writer has not caught up
+            *wake = true;
+            return false;
+        } else {
+            pos = atomic_load_explicit(&log_queue_tail, memory_order_relaxed);
+        }
+    }
+
+    cell->level = level;
+    memcpy(cell->timestamp, timestamp, sizeof(cell->timestamp));
+    memcpy(cell->iso_timestamp, iso_timestamp, sizeof(cell->iso_timestamp));
+    memcpy(cell->message, message, len + 1);
+    atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+
+    // During bursts the writer drains every quarter of the queue
+    *wake = (pos + 1) % (LOG_QUEUE_SIZE / 4) == 0;
+    return true;
+}
+
+// Write every queued line, then flush once
+// Only called by the writer thread, or once it has stopped
+static int log_queue_drain(void) {
+    extern __attribute__((weak)) int write_json_log(log_level_t level, const char *timestamp, const char *message);
+    int count = 0;
+
+    pthread_mutex_lock(&logger.mutex);
+    for (;;) {
+        log_queue_cell_t *cell = &log_queue[log_queue_head % LOG_QUEUE_SIZE];
+        if (atomic_load_explicit(&cell->seq, memory_order_acquire) != log_queue_head + 1) {
+            break;
+        }
+
+        write_log_line(cell->level, cell->timestamp, cell->message);
+        if (write_json_log) {
+            write_json_log(cell->level, cell->iso_timestamp, cell->message);
+        }
+
+        // Hand the cell back for the next round of the queue
+        atomic_store_explicit(&cell->seq, log_queue_head + LOG_QUEUE_SIZE, memory_order_release);
+        log_queue_head++;
+        count++;
+    }
+    if (count > 0) {
+        flush_log_lines();
+    }
+    pthread_mutex_unlock(&logger.mutex);
+
+    return count;
+}
+
+// Writer thread: wakes on errors or every LOG_ASYNC_FLUSH_MS
+static void *log_writer_func(void *arg) {
+    (void)arg;
+    // Named directly, tools built without the video code link the logger too
+    pthread_setname_np(pthread_self(), "logger");
+
+    while (atomic_load(&log_async_running)) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += LOG_ASYNC_FLUSH_MS * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        while (sem_timedwait(&log_wakeup, &deadline) != 0 && errno == EINTR) {
+        }
+
+        log_queue_drain();
+    }
+
+    return NULL;
+}
+
+// A forked child has no writer thread, so it writes its lines directly
+static void log_async_atfork_child(void) {
+    atomic_store(&log_async_running, 0);
+}
+
+int set_log_async(int enable) {
+    static bool atfork_registered = false;
+
+    if (enable && !atomic_load(&log_async_running)) {
+        for (uint64_t i = 0; i < LOG_QUEUE_SIZE; i++) {
+            atomic_store_explicit(&log_queue[i].seq, log_queue_tail + i, memory_order_relaxed);
+        }
+        log_queue_head = log_queue_tail;
+
+        if (sem_init(&log_wakeup, 0, 0) != 0) {
+            return -1;
+        }
+        atomic_store(&log_async_running, 1);
+        if (pthread_create(&log_writer, NULL, log_writer_func, NULL) != 0) {
+            atomic_store(&log_async_running, 0);
+            sem_destroy(&log_wakeup);
+            return -1;
+        }
+        if (!atfork_registered) {
+            pthread_atfork(NULL, NULL, log_async_atfork_child);
+            atfork_registered = true;
+        }
+    } else if (!enable && atomic_load(&log_async_running)) {
+        atomic_store(&log_async_running, 0);
+        sem_post(&log_wakeup);
+        pthread_join(log_writer, NULL);
+        sem_destroy(&log_wakeup);
+
+        // Lines queued while the thread was stopping
+        log_queue_drain();
+    }
+
+    return 0;
+}
+
 // Initialize the logging system
 int init_logger(void) {
     // Initialize mutex
@@ -65,6 +359,9 @@ int init_logger(void) {
 
 // Shutdown the logging system
 void shutdown_logger(void) {
+    // Write out what the asynchronous logger still has queued
+    set_log_async(0);
+
     pthread_mutex_lock(&logger.mutex);
 
     if (logger.log_file != NULL && logger.log_file != stdout && logger.log_file != stderr) {
@@ -199,7 +496,7 @@ int set_log_file(const char *filename) {
 }
 
 // Log a message at ERROR level
-void log_error(const char *format, ...) {
+void (log_error)(const char *format, ...) {
     va_list args;
     va_start(args, format);
     log_message_v(LOG_LEVEL_ERROR, format, args);
@@ -207,7 +504,7 @@ void log_error(const char *format, ...) {
 }
 
 // Log a message at WARN level
-void log_warn(const char *format, ...) {
+void (log_warn)(const char *format, ...) {
     va_list args;
     va_start(args, format);
     log_message_v(LOG_LEVEL_WARN, format, args);
@@ -215,7 +512,7 @@ void log_warn(const char *format, ...) {
 }
 
 // Log a message at INFO level
-void log_info(const char *format, ...) {
+void (log_info)(const char *format, ...) {
     va_list args;
     va_start(args, format);
     log_message_v(LOG_LEVEL_INFO, format, args);
@@ -223,13 +520,37 @@ void log_info(const char *format, ...) {
 }
 
 // Log a message at DEBUG level
-void log_debug(const char *format, ...) {
+void (log_debug)(const char *format, ...) {
     va_list args;
     va_start(args, format);
     log_message_v(LOG_LEVEL_DEBUG, format, args);
     va_end(args);
 }
 
+// Count a message against its call site's limit
+int log_ratelimit(log_ratelimit_t *rl, int interval, int burst, int *suppressed) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    long now = (long)ts.tv_sec;
+
+    *suppressed = 0;
+
+    // The thread that moves the window on reports what the old one dropped
+    long start = atomic_load_explicit(&rl->window_start, memory_order_relaxed);
+    if (start == 0 || now - start >= interval) {
+        if (atomic_compare_exchange_strong(&rl->window_start, &start, now)) {
+            *suppressed = atomic_exchange(&rl->suppressed, 0);
+            atomic_store(&rl->count, 0);
+        }
+    }
+
+    if (atomic_fetch_add_explicit(&rl->count, 1, memory_order_relaxed) < burst) {
+        return 1;
+    }
+    atomic_fetch_add_explicit(&rl->suppressed, 1, memory_order_relaxed);
+    return 0;
+}
+
 // Log a message at the specified level
 void log_message(log_level_t level, const char *format, ...) {
     va_list args;
@@ -302,20 +623,24 @@ void log_message_v(log_level_t level, const char *format, va_list args) {
     char message[4096];
     vsnprintf(message, sizeof(message), format, args);
 
-    pthread_mutex_lock(&logger.mutex);
+    // Keep it in memory for the system logs page
+    log_ring_write(level, timestamp, message);
 
-    // Write to log file if available
-    if (logger.log_file && logger.log_file != stdout && logger.log_file != stderr) {
-        fprintf(logger.log_file, "[%s] [%s] %s\n", timestamp, log_level_strings[level], message);
-        fflush(logger.log_file);
+    // The writer thread takes it from here; errors wake it to flush right away
+    if (atomic_load_explicit(&log_async_running, memory_order_relaxed)) {
+        bool wake = false;
+        bool queued = log_queue_push(&wake, level, timestamp, iso_timestamp, message);
+        if (wake || (queued && level == LOG_LEVEL_ERROR)) {
+            sem_post(&log_wakeup);
+        }
+        if (queued) {
+            return;
+        }
     }
 
-    // Always write to console (tee behavior)
-    // Use stderr for errors, stdout for other levels
-    FILE *console = (level == LOG_LEVEL_ERROR) ? stderr : stdout;
-    fprintf(console, "[%s] [%s] %s\n", timestamp, log_level_strings[level], message);
-    fflush(console);
-
+    pthread_mutex_lock(&logger.mutex);
+    write_log_line(level, timestamp, message);
+    flush_log_lines();
     pthread_mutex_unlock(&logger.mutex);
 
     // Write to JSON log file if the function is available
@@ -13,20 +13,29 @@
 #include <sys/time.h>
 #include <sys/utsname.h>
 #include <limits.h>
+#include <time.h>
 
 #include "core/version.h"
 #include "core/config.h"
 #include "core/logger.h"
 #include "core/daemon.h"
 #include "core/shutdown_coordinator.h"
+#include "core/event_bus.h"
+#include "core/device_profile.h"
+#include "utils/memory.h"
 #include "video/stream_manager.h"
 #include "video/stream_state.h"
 #include "video/stream_state_adapter.h"
 #include "storage/storage_manager.h"
 #include "storage/storage_manager_streams_cache.h"
+#include "storage/storage_io.h"
 #include "video/streams.h"
 #include "video/hls_streaming.h"
 #include "video/mp4_recording.h"
+#include "video/mp4_recovery.h"
+#include "video/stream_ingest.h"
+#include "video/stream_supervisor.h"
+#include "video/dns_cache.h"
 #include "video/stream_transcoding.h"
 #include "video/hls_writer.h"
 #include "video/detection_stream.h"
@@ -34,6 +43,15 @@
 #include "video/detection_integration.h"
 #include "video/detection_recording.h"
 #include "video/detection_stream_thread.h"
+#include "video/detection_replay.h"
+#include "video/detection_scheduler.h"
+#include "video/load_governor.h"
+#include "video/mp4_standby.h"
+#include "video/mjpeg_broadcast.h"
+#include "storage/storage_latency.h"
+#include "video/stream_startup.h"
+#include "video/stream_arena.h"
+#include "video/thread_utils.h"
 #include "video/timestamp_manager.h"
 #include "video/onvif_discovery.h"
 #include "video/ffmpeg_leak_detector.h"
@@ -440,8 +458,71 @@ static int daemonize(const char *pid_file) {
     return 0;
 }
 
-// Function to check and ensure recording is active for streams that have recording enabled
-static void check_and_ensure_services(void);
+// Start HLS, recording and detection for one stream
+static int ensure_stream_services(int index);
+
+/**
+ * Parse a replay time: Unix seconds, or local "YYYY-MM-DD HH:MM:SS" (a T
+ * between date and time works too)
+ *
+ * @return Time, or 0 if the text is neither
+ */
+static time_t parse_replay_time(const char *text) {
+    char *end;
+    long long seconds = strtoll(text, &end, 10);
+    if (end != text && *end == '\0') {
+        return (time_t)seconds;
+    }
+
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    const char *rest = strptime(text, "%Y-%m-%d %H:%M:%S", &tm);
+    if (!rest || *rest != '\0') {
+        memset(&tm, 0, sizeof(tm));
+        rest = strptime(text, "%Y-%m-%dT%H:%M:%S", &tm);
+    }
+    if (!rest || *rest != '\0') {
+        return 0;
+    }
+    tm.tm_isdst = -1;
+    return mktime(&tm);
+}
+
+/**
+ * Run detection over recorded footage and report the throughput (--replay)
+ * The detection rate is not capped by detection_max_fps, so the numbers
+ * show what the hardware does.
+ *
+ * @return Exit status
+ */
+static int run_replay_command(const detection_replay_request_t *request) {
+    if (init_detection_system() != 0) {
+        log_error("Failed to initialize detection system");
+        return EXIT_FAILURE;
+    }
+    if (detection_scheduler_init(device_profile_value(DEVICE_KNOB_DETECTION_WORKERS), 0) != 0) {
+        log_warn("Failed to start detection workers, detecting on the replay threads");
+    }
+
+    detection_replay_status_t status;
+    int result = detection_replay_run(request, &status);
+
+    detection_scheduler_shutdown();
+    shutdown_detection_system();
+
+    if (status.state == DETECTION_REPLAY_FAILED) {
+        fprintf(stderr, "Replay failed: %s\n", status.error);
+    } else {
+        double elapsed = status.elapsed_seconds > 0 ? status.elapsed_seconds : 1e-9;
+        printf("Replayed %d recordings (%d unreadable), %.0f s of footage\n",
+               status.recordings, status.recordings_failed, status.footage_seconds);
+        printf("%llu frames, %llu detections%s\n", (unsigned long long)status.frames,
+               (unsigned long long)status.detections, request->store ? " stored" : "");
+        printf("%.1f s, %.2f frames/s, %.1fx real time\n", status.elapsed_seconds,
+               (double)status.frames / elapsed, status.footage_seconds / elapsed);
+    }
+    return result == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
 
 int main(int argc, char *argv[]) {
     int pid_fd = -1;
@@ -459,6 +540,12 @@ int main(int argc, char *argv[]) {
     // Define a variable to store the custom config path
     char custom_config_path[MAX_PATH_LENGTH] = {0};
 
+    // Set by --replay and its options; the detections are stored unless --dry-run
+    detection_replay_request_t replay_request;
+    memset(&replay_request, 0, sizeof(replay_request));
+    replay_request.store = true;
+    bool replay_mode = false;
+
     // Parse command line arguments
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "-d") == 0 || strcmp(argv[i], "--daemon") == 0) {
@@ -473,6 +560,24 @@ int main(int argc, char *argv[]) {
                 log_error("Missing config file path");
                 return EXIT_FAILURE;
             }
+        } else if ((strcmp(argv[i], "--replay") == 0 || strcmp(argv[i], "--from") == 0 ||
+                    strcmp(argv[i], "--to") == 0 || strcmp(argv[i], "--model") == 0 ||
+                    strcmp(argv[i], "--interval") == 0) && i + 1 < argc) {
+            const char *value = argv[++i];
+            if (strcmp(argv[i - 1], "--replay") == 0) {
+                replay_mode = true;
+                snprintf(replay_request.stream_name, sizeof(replay_request.stream_name), "%s", value);
+            } else if (strcmp(argv[i - 1], "--from") == 0) {
+                replay_request.start_time = parse_replay_time(value);
+            } else if (strcmp(argv[i - 1], "--to") == 0) {
+                replay_request.end_time = parse_replay_time(value);
+            } else if (strcmp(argv[i - 1], "--model") == 0) {
+                snprintf(replay_request.model_path, sizeof(replay_request.model_path), "%s", value);
+            } else {
+                replay_request.interval = atoi(value);
+            }
+        } else if (strcmp(argv[i], "--dry-run") == 0) {
+            replay_request.store = false;
         } else if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
             printf("Usage: %s [options]\n", argv[0]);
             printf("Options:\n");
@@ -480,6 +585,13 @@ int main(int argc, char *argv[]) {
             printf("  -c, --config FILE   Use config file\n");
             printf("  -h, --help          Show this help\n");
             printf("  -v, --version       Show version\n");
+            printf("\nDetection replay over recorded footage:\n");
+            printf("  --replay STREAM     Run detection over the recordings of STREAM and exit\n");
+            printf("  --from TIME         Start of the range (Unix seconds or \"YYYY-MM-DD HH:MM:SS\")\n");
+            printf("  --to TIME           End of the range\n");
+            printf("  --model FILE        Model to use instead of the stream's\n");
+            printf("  --interval SEC      Seconds between the key frames detected on (default: every one)\n");
+            printf("  --dry-run           Only measure throughput, store no detections\n");
             return EXIT_SUCCESS;
         } else if (strcmp(argv[i], "-v") == 0 || strcmp(argv[i], "--version") == 0) {
             // Version already printed in banner
@@ -504,6 +616,20 @@ int main(int argc, char *argv[]) {
 
     log_info("LightNVR v%s starting up", LIGHTNVR_VERSION_STRING);
 
+    // Size buffers, caches and pools for this device before anything allocates them
+    device_profile_init(&config);
+    set_log_buffer_entries(device_profile_value(DEVICE_KNOB_LOG_BUFFER_ENTRIES));
+    set_database_sizes(device_profile_value(DEVICE_KNOB_DB_CACHE_KB),
+                       device_profile_value(DEVICE_KNOB_DB_MMAP_MB));
+
+    // Account memory per subsystem before any of them allocates
+    memory_set_usage_source(MEMORY_TAG_DB, get_database_memory_usage);
+    memory_set_usage_source(MEMORY_TAG_LOGGER, get_logger_memory_usage);
+    memory_accounting_init((size_t)device_profile_value(DEVICE_KNOB_MEMORY_BUDGET_MB) * 1024 * 1024);
+
+    // Worker threads apply the CPU affinity and priority of their class when they start
+    thread_utils_configure(config.thread_sched);
+
     // Initialize database
     if (init_database(config.db_path) != 0) {
         log_error("Failed to initialize database");
@@ -515,6 +641,15 @@ int main(int argc, char *argv[]) {
     init_schema_cache();
     log_info("Schema cache initialized");
 
+    // A replay only needs the database and the detection models, and may run
+    // beside the instance serving the cameras, so nothing else is started
+    if (replay_mode) {
+        set_log_level(config.log_level);
+        int status = run_replay_command(&replay_request);
+        shutdown_database();
+        return status;
+    }
+
     // Initialize storage manager
     if (init_storage_manager(config.storage_path, config.max_storage_size) != 0) {
         log_error("Failed to initialize storage manager");
@@ -522,6 +657,9 @@ int main(int argc, char *argv[]) {
     }
     log_info("Storage manager initialized");
 
+    // Recordings cut short by a crash or power loss, before new ones are started
+    mp4_recovery_finalize_incomplete();
+
     // Load stream configurations from database
     if (load_stream_configs(&config) < 0) {
         log_error("Failed to load stream configurations from database");
@@ -637,6 +775,11 @@ int main(int argc, char *argv[]) {
         }
     }
 
+    // The writer thread is started after daemonizing, as it would not survive the fork
+    if (config.log_async && set_log_async(1) != 0) {
+        log_warn("Failed to start asynchronous logging, writing log lines directly");
+    }
+
     // Initialize stream state manager
     if (init_stream_state_manager(config.max_streams) != 0) {
         log_error("Failed to initialize stream state manager");
@@ -691,37 +834,20 @@ int main(int argc, char *argv[]) {
 
         // Start go2rtc service (or use existing service if already running)
         if (go2rtc_stream_start_service()) {
+            // start_service only returns once go2rtc answers API requests
             log_info("go2rtc service started successfully or existing service detected");
 
-            // Wait for go2rtc service to be fully ready
-            log_info("Waiting for go2rtc service to be fully ready...");
-            int retries = 10;
-            while (retries > 0 && !go2rtc_stream_is_ready()) {
-                log_info("Waiting for go2rtc service to be ready... (%d retries left)", retries);
-                sleep(1);
-                retries--;
-            }
-
-            if (!go2rtc_stream_is_ready()) {
-                log_error("go2rtc service failed to be ready in time");
-            } else {
-                log_info("go2rtc service is now fully ready");
-            }
-
             // Initialize go2rtc consumer integration
             if (go2rtc_integration_init()) {
                 log_info("go2rtc consumer integration initialized successfully");
 
                 // Register all existing streams with go2rtc
                 log_info("Registering all existing streams with go2rtc");
+                // Each stream is added by a synchronous API request, so they
+                // are registered once this returns
                 if (!go2rtc_integration_register_all_streams()) {
                     log_warn("Failed to register all streams with go2rtc");
                     // Continue anyway
-                } else {
-                    // Wait a bit for streams to be fully registered
-                    log_info("Waiting for streams to be fully registered with go2rtc...");
-                    sleep(3);
-                    log_info("Streams should now be fully registered with go2rtc");
                 }
             } else {
                 log_error("Failed to initialize go2rtc consumer integration");
@@ -741,6 +867,15 @@ int main(int argc, char *argv[]) {
     init_timestamp_trackers();
     log_info("Timestamp trackers initialized");
 
+    // Keeps camera host names resolved so reconnects do not wait on DNS
+    dns_cache_start();
+
+    // Initialize shared ingest before its consumers
+    init_stream_ingest_system();
+
+    // Restarts pipeline stages of streams that stop making progress
+    start_stream_supervisor();
+
     init_hls_streaming_backend();
     init_mp4_recording_backend();
     log_info("MP4 writer shutdown system initialized");
@@ -759,6 +894,26 @@ int main(int argc, char *argv[]) {
     // Initialize detection stream system
     init_detection_stream_system();
 
+    // Initialize load governor
+    if (load_governor_init() != 0) {
+        log_error("Failed to initialize load governor");
+    }
+
+    // Rate the recording disks by their write latency
+    if (storage_latency_init() != 0) {
+        log_error("Failed to initialize storage latency monitor");
+    }
+
+    // Keep MP4 outputs ready for detection-triggered recordings
+    if (mp4_standby_init() != 0) {
+        log_error("Failed to initialize MP4 standby outputs");
+    }
+
+    // Encode live MJPEG frames once for all viewers
+    if (mjpeg_broadcast_init() != 0) {
+        log_error("Failed to initialize live MJPEG");
+    }
+
     // Initialize ONVIF discovery module
     if (init_onvif_discovery() != 0) {
         log_error("Failed to initialize ONVIF discovery module");
@@ -786,90 +941,6 @@ int main(int argc, char *argv[]) {
         log_info("Authentication system initialized successfully");
     }
 
-    // Check if detection models exist and start detection-based recording - MOVED TO END OF SETUP
-    for (int i = 0; i < config.max_streams; i++) {
-        if (config.streams[i].name[0] != '\0' && config.streams[i].enabled &&
-            config.streams[i].detection_based_recording && config.streams[i].detection_model[0] != '\0') {
-
-            // Check if model file exists
-            char model_path[MAX_PATH_LENGTH];
-            if (config.streams[i].detection_model[0] != '/') {
-                // Relative path, use configured models path from INI if it exists
-                if (config.models_path && strlen(config.models_path) > 0) {
-                    snprintf(model_path, sizeof(model_path), "%s/%s", config.models_path, config.streams[i].detection_model);
-                } else {
-                    // Fall back to default path if INI config doesn't exist
-                    snprintf(model_path, MAX_PATH_LENGTH, "/etc/lightnvr/models/%s", config.streams[i].detection_model);
-                }
-            } else {
-                // Absolute path
-                strncpy(model_path, config.streams[i].detection_model, MAX_PATH_LENGTH - 1);
-            }
-
-            // Check if file exists
-            FILE *model_file = fopen(model_path, "r");
-            if (model_file) {
-                fclose(model_file);
-                log_info("Detection model found: %s", model_path);
-            } else {
-                log_error("Detection model not found: %s", model_path);
-                log_error("Detection will not work properly!");
-
-                // Create the models directory if it doesn't exist
-                if (mkdir(config.models_path, 0755) != 0 && errno != EEXIST) {
-                    log_error("Failed to create models directory: %s", strerror(errno));
-                } else {
-                    log_info("Created models directory: %s", config.models_path);
-                }
-            }
-
-            log_info("Starting detection-based recording for stream %s with model %s",
-                    config.streams[i].name, config.streams[i].detection_model);
-
-            // Start detection stream reader with more detailed logging
-            log_info("Starting detection stream reader for stream %s with model %s",
-                    config.streams[i].name, config.streams[i].detection_model);
-
-            int detection_interval = config.streams[i].detection_interval > 0 ?
-                                    config.streams[i].detection_interval : 10;
-
-            // First register the detection stream reader
-            int result = start_detection_stream_reader(config.streams[i].name, detection_interval);
-            if (result == 0) {
-                log_info("Successfully started detection stream reader for stream %s",
-                        config.streams[i].name);
-
-                // Verify the reader is running
-                if (is_detection_stream_reader_running(config.streams[i].name)) {
-                    log_info("Confirmed detection stream reader is running for %s",
-                            config.streams[i].name);
-                } else {
-                    log_warn("Detection stream reader reported as not running for %s despite successful start",
-                            config.streams[i].name);
-                }
-            } else {
-                log_error("Failed to start detection stream reader for stream %s: error code %d",
-                        config.streams[i].name, result);
-            }
-
-            // Now directly start the detection thread
-            log_info("Directly starting detection thread for stream %s", config.streams[i].name);
-
-            // Construct HLS directory path
-            char hls_dir[MAX_PATH_LENGTH];
-            snprintf(hls_dir, MAX_PATH_LENGTH, "/var/lib/lightnvr/recordings/hls/%s", config.streams[i].name);
-
-            // Start the detection thread
-            if (start_stream_detection_thread(config.streams[i].name, model_path,
-                                             config.streams[i].detection_threshold,
-                                             config.streams[i].detection_interval, hls_dir) != 0) {
-                log_warn("Failed to start detection thread for stream %s", config.streams[i].name);
-            } else {
-                log_info("Successfully started detection thread for stream %s", config.streams[i].name);
-            }
-        }
-    }
-
     // Initialize Mongoose web server with direct handlers
     http_server_config_t server_config = {
         .port = config.web_port,
@@ -877,8 +948,15 @@ int main(int argc, char *argv[]) {
         .auth_enabled = config.web_auth_enabled,
         .cors_enabled = true,
         .ssl_enabled = false,
-        .max_connections = 100,
-        .connection_timeout = 30,
+        .max_connections = config.web_max_connections,
+        .max_connections_per_ip = config.web_max_connections_per_ip,
+        .connection_timeout = config.web_idle_timeout,
+        .header_timeout = config.web_header_timeout,
+        .send_buffer_limit = (size_t)config.web_send_buffer_kb * 1024,
+        .worker_threads = config.web_thread_pool_size,
+        .request_queue_size = config.web_request_queue_size,
+        .route_max_concurrency = config.web_route_max_concurrency,
+        .event_loops = config.web_event_loops,
         .daemon_mode = daemon_mode,
     };
 
@@ -906,7 +984,12 @@ int main(int argc, char *argv[]) {
     }
 
     log_info("Mongoose web server started on port %d", config.web_port);
-    check_and_ensure_services();
+
+    // Streams need the database, go2rtc and the ingest system, all up by now
+    if (stream_startup_begin(config.streams, config.max_streams, config.startup_concurrency,
+                             ensure_stream_services) != 0) {
+        log_error("Failed to start streams");
+    }
     print_detection_stream_status();
     log_info("LightNVR initialized successfully");
 
@@ -916,6 +999,7 @@ int main(int argc, char *argv[]) {
         static time_t last_log_time = 0;
         static time_t last_status_time = 0;
         static time_t last_ffmpeg_leak_check_time = 0;
+        static time_t last_model_eviction_time = 0;
         time_t now = time(NULL);
 
         if (now - last_log_time > 60) {
@@ -931,19 +1015,24 @@ int main(int argc, char *argv[]) {
 
         // Check for FFmpeg memory leaks every 10 minutes
         if (now - last_ffmpeg_leak_check_time > 600) {
-            log_info("Checking for FFmpeg memory leaks...");
             int allocation_count = ffmpeg_get_allocation_count();
-            log_info("Current FFmpeg allocations: %d", allocation_count);
+            log_debug("Current FFmpeg allocations: %d", allocation_count);
 
-            // If there are more than 100 allocations, dump them to the log
-            if (allocation_count > 100) {
-                log_warn("Potential FFmpeg memory leak detected: %d allocations", allocation_count);
+            // Stream threads hold a fixed number of objects each, so only
+            // a thread holding more than that points at a leak
+            if (ffmpeg_leak_detector_check() > 0) {
                 ffmpeg_dump_allocations();
             }
 
             last_ffmpeg_leak_check_time = now;
         }
 
+        // Unload detection models that idle streams are not using
+        if (now - last_model_eviction_time >= 30) {
+            evict_idle_detection_models();
+            last_model_eviction_time = now;
+        }
+
         // Process events, monitor system health, etc.
         sleep(1);
     }
@@ -954,6 +1043,9 @@ int main(int argc, char *argv[]) {
 cleanup:
     log_info("Starting cleanup process...");
 
+    // Stop bringing up streams before their services are torn down
+    stream_startup_shutdown();
+
     // We'll clean up go2rtc later in the shutdown sequence
     // First clean up go2rtc integration (but not the process yet)
     #ifdef USE_GO2RTC
@@ -997,6 +1089,14 @@ cleanup:
         // Wait a moment for callbacks to clear and any in-progress operations to complete
         usleep(1000000);  // 1000ms (increased from 500ms)
 
+        // All component tiers share one deadline, so a slow tier leaves less time for the next
+        struct timespec stop_deadline;
+        get_shutdown_deadline(SHUTDOWN_STOP_TIMEOUT_MS, &stop_deadline);
+
+        // Nothing may be restarted while it is being stopped
+        stop_stream_supervisor();
+        dns_cache_stop();
+
         // Stop all detection stream readers first
         log_info("Stopping all detection stream readers...");
         for (int i = 0; i < config.max_streams; i++) {
@@ -1006,26 +1106,9 @@ cleanup:
 
                 log_info("Stopping detection stream reader for: %s", config.streams[i].name);
                 stop_detection_stream_reader(config.streams[i].name);
-
-                // Update component state
-                char component_name[128];
-                snprintf(component_name, sizeof(component_name), "detection_thread_%s", config.streams[i].name);
-                int component_id = -1;
-                for (int j = 0; j < atomic_load(&get_shutdown_coordinator()->component_count); j++) {
-                    if (strcmp(get_shutdown_coordinator()->components[j].name, component_name) == 0) {
-                        component_id = j;
-                        break;
-                    }
-                }
-                if (component_id >= 0) {
-                    update_component_state(component_id, COMPONENT_STOPPED);
-                }
             }
         }
 
-        // Wait for detection stream readers to stop
-        usleep(500000);  // 500ms
-
         // Stop all streams to ensure clean shutdown
         for (int i = 0; i < config.max_streams; i++) {
             if (config.streams[i].name[0] != '\0') {
@@ -1037,61 +1120,27 @@ cleanup:
             }
         }
 
-        // Wait longer for streams to stop
-        usleep(1500000);  // 1500ms
+        // Detection and HLS threads exit on their own once shutdown is initiated
+        wait_for_components_stopped(COMPONENT_PRIORITY_HLS, &stop_deadline);
 
         // Finalize all MP4 recordings first before cleaning up the backend
         log_info("Finalizing all MP4 recordings...");
         close_all_mp4_writers();
-
-        // Update MP4 writer components state
-        for (int i = 0; i < config.max_streams; i++) {
-            if (config.streams[i].name[0] != '\0' && config.streams[i].record) {
-                char component_name[128];
-                snprintf(component_name, sizeof(component_name), "mp4_writer_%s", config.streams[i].name);
-                int component_id = -1;
-                for (int j = 0; j < atomic_load(&get_shutdown_coordinator()->component_count); j++) {
-                    if (strcmp(get_shutdown_coordinator()->components[j].name, component_name) == 0) {
-                        component_id = j;
-                        break;
-                    }
-                }
-                if (component_id >= 0) {
-                    update_component_state(component_id, COMPONENT_STOPPED);
-                }
-            }
-        }
+        wait_for_components_stopped(COMPONENT_PRIORITY_MP4, &stop_deadline);
 
         // Clean up HLS directories
         log_info("Cleaning up HLS directories...");
         cleanup_hls_directories();
 
-        // Update HLS writer components state
-        for (int i = 0; i < config.max_streams; i++) {
-            if (config.streams[i].name[0] != '\0') {
-                char component_name[128];
-                snprintf(component_name, sizeof(component_name), "hls_writer_%s", config.streams[i].name);
-                int component_id = -1;
-                for (int j = 0; j < atomic_load(&get_shutdown_coordinator()->component_count); j++) {
-                    if (strcmp(get_shutdown_coordinator()->components[j].name, component_name) == 0) {
-                        component_id = j;
-                        break;
-                    }
-                }
-                if (component_id >= 0) {
-                    update_component_state(component_id, COMPONENT_STOPPED);
-                }
-            }
-        }
-
         // Now clean up the backends in the correct order
         // First stop all detection streams
         log_info("Cleaning up detection stream system...");
+        load_governor_shutdown();
+        mjpeg_broadcast_shutdown();
+        mp4_standby_shutdown();
+        storage_latency_shutdown();
         shutdown_detection_stream_system();
 
-        // Wait for detection streams to stop
-        usleep(1000000);  // 1000ms
-
         // Clean up all HLS writers first to ensure proper FFmpeg resource cleanup
         log_info("Cleaning up all HLS writers...");
         cleanup_all_hls_writers();
@@ -1100,15 +1149,21 @@ cleanup:
         log_info("Cleaning up HLS streaming backend...");
         cleanup_hls_streaming_backend();
 
-        // Wait for HLS streaming to clean up
-        usleep(1000000);  // 1000ms
-
         // Now clean up MP4 recording
         log_info("Cleaning up MP4 recording backend...");
         cleanup_mp4_recording_backend();
 
-        // Wait for MP4 recording to clean up
-        usleep(1000000);  // 1000ms
+        // Producers are gone; subscribers finish what was published, such as
+        // the last recordings to upload
+        log_info("Shutting down event bus...");
+        event_bus_shutdown();
+
+        // Stop shared ingest threads once their consumers are gone
+        log_info("Shutting down shared stream ingest...");
+        shutdown_stream_ingest_system();
+
+        // Writers are closed, so the storage I/O queues only hold data being written out
+        storage_io_shutdown();
 
         // Clean up FFmpeg resources
         log_info("Cleaning up transcoding backend...");
@@ -1140,6 +1195,7 @@ cleanup:
 
         log_info("Shutting down stream state manager...");
         shutdown_stream_state_manager();
+        stream_arena_shutdown();
 
         log_info("Shutting down storage manager...");
         shutdown_storage_manager();
@@ -1201,6 +1257,9 @@ cleanup:
     } else {
         // Fork failed
         log_error("Failed to create watchdog process for cleanup timeout");
+        stop_stream_supervisor();
+        dns_cache_stop();
+
         // Stop all streams first
         for (int i = 0; i < config.max_streams; i++) {
             if (config.streams[i].name[0] != '\0') {
@@ -1218,9 +1277,16 @@ cleanup:
         close_all_mp4_writers();
 
         // Then clean up backends in the correct order
+        load_governor_shutdown();
+        mjpeg_broadcast_shutdown();
+        mp4_standby_shutdown();
+        storage_latency_shutdown();
         shutdown_detection_stream_system();
         cleanup_mp4_recording_backend();
+        event_bus_shutdown();
         cleanup_hls_streaming_backend();
+        shutdown_stream_ingest_system();
+        storage_io_shutdown();
         cleanup_transcoding_backend();
 
         // Shut down remaining components
@@ -1230,6 +1296,7 @@ cleanup:
         shutdown_stream_manager();
         shutdown_stream_state_adapter();
         shutdown_stream_state_manager();
+        stream_arena_shutdown();
         shutdown_storage_manager();
 
         // Ensure all database operations are complete before cleanup
@@ -1280,67 +1347,121 @@ cleanup:
 }
 
 /**
- * Function to check and ensure recording is active for streams that have recording enabled
+ * Start HLS, recording and detection for one stream
+ * Called from the stream startup workers, several streams at a time.
  */
-static void check_and_ensure_services(void) {
+static int ensure_stream_services(int index) {
+    stream_config_t *stream = &config.streams[index];
+    int result = 0;
+
     // CRITICAL FIX: Skip starting new services during shutdown
     // This prevents memory leaks caused by starting new threads during shutdown
     if (is_shutdown_initiated()) {
-        log_debug("Skipping service check during shutdown");
-        return;
+        log_debug("Skipping service start for %s during shutdown", stream->name);
+        return 0;
+    }
+
+    if (stream->streaming_enabled) {
+        #ifdef USE_GO2RTC
+        // First ensure HLS streaming is active (required for MP4 recording)
+        if (go2rtc_integration_start_hls(stream->name) != 0) {
+            log_warn("Failed to start HLS streaming for stream: %s", stream->name);
+            result = -1;
+        }
+        #else
+        // First ensure HLS streaming is active (required for MP4 recording)
+        if (start_hls_stream(stream->name) != 0) {
+            log_warn("Failed to start HLS streaming for stream: %s", stream->name);
+            result = -1;
+        }
+        #endif
     }
-    for (int i = 0; i < config.max_streams; i++) {
-        if (config.streams[i].name[0] != '\0' && config.streams[i].enabled && config.streams[i].record) {
-            // Check if MP4 recording is active for this stream
-            int recording_state = get_recording_state(config.streams[i].name);
 
-            if (recording_state == 0) {
-                // Recording is not active, start it
-                log_info("Ensuring MP4 recording is active for stream: %s", config.streams[i].name);
+    if (stream->record && get_recording_state(stream->name) == 0) {
+        // Recording is not active, start it
+        log_info("Ensuring MP4 recording is active for stream: %s", stream->name);
 
-                #ifdef USE_GO2RTC
-                // Start MP4 recording
-                if (go2rtc_integration_start_recording(config.streams[i].name) != 0) {
-                    log_warn("Failed to start MP4 recording for stream: %s", config.streams[i].name);
-                } else {
-                    log_info("Successfully started MP4 recording for stream: %s (using go2rtc if available)", config.streams[i].name);
-                }
-                #else
-                // Start MP4 recording
-                if (start_mp4_recording(config.streams[i].name) != 0) {
-                    log_warn("Failed to start MP4 recording for stream: %s", config.streams[i].name);
-                } else {
-                    log_info("Successfully started MP4 recording for stream: %s", config.streams[i].name);
-                }
-                #endif
-            }
+        #ifdef USE_GO2RTC
+        if (go2rtc_integration_start_recording(stream->name) != 0) {
+            log_warn("Failed to start MP4 recording for stream: %s", stream->name);
+            result = -1;
+        } else {
+            log_info("Successfully started MP4 recording for stream: %s (using go2rtc if available)", stream->name);
         }
-        if (config.streams[i].name[0] != '\0' && config.streams[i].enabled && config.streams[i].streaming_enabled) {
-            #ifdef USE_GO2RTC
-            // First ensure HLS streaming is active (required for MP4 recording)
-            if (go2rtc_integration_start_hls(config.streams[i].name) != 0) {
-                log_warn("Failed to start HLS streaming for stream: %s", config.streams[i].name);
-                // Continue anyway, as the HLS streaming might already be running
-            }
+        #else
+        if (start_mp4_recording(stream->name) != 0) {
+            log_warn("Failed to start MP4 recording for stream: %s", stream->name);
+            result = -1;
+        } else {
+            log_info("Successfully started MP4 recording for stream: %s", stream->name);
+        }
+        #endif
+    }
 
-            #else
-            // First ensure HLS streaming is active (required for MP4 recording)
-            if (start_hls_stream(config.streams[i].name) != 0) {
-                log_warn("Failed to start HLS streaming for stream: %s", config.streams[i].name);
-                // Continue anyway, as the HLS streaming might already be running
-            }
-            #endif
+    if (!stream->detection_based_recording) {
+        return result;
+    }
+    if (stream->detection_model[0] == '\0') {
+        log_warn("Detection-based recording enabled for stream %s without a model", stream->name);
+        return -1;
+    }
+
+    // Check if model file exists
+    char model_path[MAX_PATH_LENGTH];
+    if (stream->detection_model[0] != '/') {
+        // Relative path, use configured models path from INI if it exists
+        if (config.models_path && strlen(config.models_path) > 0) {
+            snprintf(model_path, sizeof(model_path), "%s/%s", config.models_path, stream->detection_model);
+        } else {
+            // Fall back to default path if INI config doesn't exist
+            snprintf(model_path, MAX_PATH_LENGTH, "/etc/lightnvr/models/%s", stream->detection_model);
         }
-        // Handle detection-based recording - MOVED TO END OF SETUP
-        if (config.streams[i].name[0] != '\0' && config.streams[i].enabled && config.streams[i].detection_based_recording) {
-            log_info("Ensuring detection-based recording is active for stream: %s", config.streams[i].name);
-            if (start_stream_detection_thread(config.streams[i].name, config.streams[i].detection_model,
-                                             config.streams[i].detection_threshold,
-                                             config.streams[i].detection_interval, NULL) != 0) {
-                log_warn("Failed to start detection-based recording for stream: %s", config.streams[i].name);
-            } else {
-                log_info("Successfully started detection-based recording for stream: %s", config.streams[i].name);
-            }
+    } else {
+        // Absolute path
+        strncpy(model_path, stream->detection_model, MAX_PATH_LENGTH - 1);
+        model_path[MAX_PATH_LENGTH - 1] = '\0';
+    }
+
+    FILE *model_file = fopen(model_path, "r");
+    if (model_file) {
+        fclose(model_file);
+        log_info("Detection model found: %s", model_path);
+    } else {
+        log_error("Detection model not found: %s", model_path);
+        log_error("Detection will not work properly!");
+
+        // Create the models directory if it doesn't exist
+        if (mkdir(config.models_path, 0755) != 0 && errno != EEXIST) {
+            log_error("Failed to create models directory: %s", strerror(errno));
         }
     }
+
+    log_info("Starting detection-based recording for stream %s with model %s",
+            stream->name, stream->detection_model);
+
+    int detection_interval = stream->detection_interval > 0 ? stream->detection_interval : 10;
+
+    // First register the detection stream reader
+    int reader_result = start_detection_stream_reader(stream->name, detection_interval);
+    if (reader_result != 0) {
+        log_error("Failed to start detection stream reader for stream %s: error code %d",
+                stream->name, reader_result);
+        result = -1;
+    }
+
+    // Construct HLS directory path
+    char hls_dir[MAX_PATH_LENGTH];
+    snprintf(hls_dir, MAX_PATH_LENGTH, "/var/lib/lightnvr/recordings/hls/%s", stream->name);
+
+    // Start the detection thread
+    if (start_stream_detection_thread(stream->name, model_path,
+                                     stream->detection_threshold,
+                                     stream->detection_interval, hls_dir) != 0) {
+        log_warn("Failed to start detection thread for stream %s", stream->name);
+        result = -1;
+    } else {
+        log_info("Successfully started detection thread for stream %s", stream->name);
+    }
+
+    return result;
 }
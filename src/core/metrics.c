@@ -0,0 +1,423 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "core/metrics.h"
+#include "core/logger.h"
+
+typedef enum {
+    METRIC_COUNTER,
+    METRIC_GAUGE,
+    METRIC_HISTOGRAM
+} metric_type_t;
+
+// Bucket upper bounds in microseconds, and as written in the le label
+static const uint64_t bucket_bounds_us[METRICS_HISTOGRAM_BUCKETS] = {
+    1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000,
+    1000000, 2500000, 5000000, 10000000
+};
+static const char *const bucket_labels[METRICS_HISTOGRAM_BUCKETS] = {
+    "0.001", "0.0025", "0.005", "0.01", "0.025", "0.05", "0.1", "0.25", "0.5",
+    "1", "2.5", "5", "10"
+};
+
+// One thread's part of a counter, on its own cache line
+typedef struct {
+    _Alignas(64) atomic_uint_fast64_t value;
+} counter_shard_t;
+
+// One thread's part of a histogram; buckets are not cumulative here
+typedef struct {
+    _Alignas(64) atomic_uint_fast64_t buckets[METRICS_HISTOGRAM_BUCKETS];
+    atomic_uint_fast64_t count;
+    atomic_uint_fast64_t sum_us;
+} histogram_shard_t;
+
+typedef struct {
+    char name[96];
+    char help[160];
+    metric_type_t type;
+} metrics_family_t;
+
+typedef struct {
+    int family;
+    char *labels;                       // Formatted label pairs, e.g. stream="front",consumer="hls"
+    counter_shard_t *counter;           // METRICS_SHARDS entries for counters, gauges use the first
+    histogram_shard_t *histogram;       // METRICS_SHARDS entries for histograms
+} metrics_series_t;
+
+// Registry; registration and scrapes hold the mutex, updates never do.
+// IDs index series[], which is only ever appended to.
+static pthread_mutex_t registry_mutex = PTHREAD_MUTEX_INITIALIZER;
+static metrics_family_t families[METRICS_MAX_FAMILIES];
+static int family_count = 0;
+static metrics_series_t *series[METRICS_MAX_SERIES + 1];
+static int series_count = 0;
+
+static void (*_Atomic collectors[METRICS_MAX_COLLECTORS])(void);
+static atomic_int collector_count;
+
+static atomic_uint next_shard;
+static _Thread_local int thread_shard = -1;
+
+static inline int current_shard(void) {
+    if (thread_shard < 0) {
+        thread_shard = (int)(atomic_fetch_add_explicit(&next_shard, 1, memory_order_relaxed) % METRICS_SHARDS);
+    }
+    return thread_shard;
+}
+
+static inline metrics_series_t *get_series(metric_t metric) {
+    if (metric <= 0 || metric > METRICS_MAX_SERIES) {
+        return NULL;
+    }
+    return __atomic_load_n(&series[metric], __ATOMIC_ACQUIRE);
+}
+
+/**
+ * Format the label pairs of a registration, escaping the values
+ */
+static int format_labels(char *buf, size_t size, va_list args) {
+    size_t pos = 0;
+    const char *name;
+
+    buf[0] = '\0';
+    while ((name = va_arg(args, const char *)) != NULL) {
+        const char *value = va_arg(args, const char *);
+        if (!value) {
+            value = "";
+        }
+
+        int n = snprintf(buf + pos, size - pos, "%s%s=\"", pos > 0 ? "," : "", name);
+        if (n < 0 || (size_t)n >= size - pos) {
+            return -1;
+        }
+        pos += (size_t)n;
+
+        for (const char *p = value; *p; p++) {
+            const char *escaped = NULL;
+            if (*p == '\\') {
+                escaped = "\\\\";
+            } else if (*p == '"') {
+                escaped = "\\\"";
+            } else if (*p == '\n') {
+                escaped = "\\n";
+            }
+            size_t len = escaped ? strlen(escaped) : 1;
+            if (pos + len + 2 >= size) {
+                return -1;
+            }
+            memcpy(buf + pos, escaped ? escaped : p, len);
+            pos += len;
+        }
+        buf[pos++] = '"';
+        buf[pos] = '\0';
+    }
+    return 0;
+}
+
+static metric_t register_series(metric_type_t type, const char *name, const char *help, va_list args) {
+    char labels[512];
+    if (!name || format_labels(labels, sizeof(labels), args) != 0) {
+        log_warn("Invalid labels for metric %s", name ? name : "(null)");
+        return 0;
+    }
+
+    pthread_mutex_lock(&registry_mutex);
+
+    int family = -1;
+    for (int i = 0; i < family_count; i++) {
+        if (strcmp(families[i].name, name) == 0) {
+            family = i;
+            break;
+        }
+    }
+    if (family >= 0 && families[family].type != type) {
+        pthread_mutex_unlock(&registry_mutex);
+        log_warn("Metric %s is already registered with another type", name);
+        return 0;
+    }
+
+    if (family >= 0) {
+        for (int id = 1; id <= series_count; id++) {
+            if (series[id]->family == family && strcmp(series[id]->labels, labels) == 0) {
+                pthread_mutex_unlock(&registry_mutex);
+                return id;
+            }
+        }
+    } else if (family_count < METRICS_MAX_FAMILIES) {
+        family = family_count;
+        metrics_family_t *f = &families[family];
+        snprintf(f->name, sizeof(f->name), "%s", name);
+        snprintf(f->help, sizeof(f->help), "%s", help ? help : "");
+        f->type = type;
+    }
+
+    if (family < 0 || series_count >= METRICS_MAX_SERIES) {
+        pthread_mutex_unlock(&registry_mutex);
+        log_warn("Too many metrics, not recording %s{%s}", name, labels);
+        return 0;
+    }
+
+    metrics_series_t *s = calloc(1, sizeof(metrics_series_t));
+    size_t shards_size = type != METRIC_HISTOGRAM ?
+        METRICS_SHARDS * sizeof(counter_shard_t) : METRICS_SHARDS * sizeof(histogram_shard_t);
+    void *shards = aligned_alloc(64, shards_size);
+    char *labels_copy = strdup(labels);
+    if (!s || !shards || !labels_copy) {
+        pthread_mutex_unlock(&registry_mutex);
+        free(s);
+        free(shards);
+        free(labels_copy);
+        log_error("Failed to allocate metric %s", name);
+        return 0;
+    }
+    memset(shards, 0, shards_size);
+
+    s->family = family;
+    s->labels = labels_copy;
+    if (type != METRIC_HISTOGRAM) {
+        s->counter = shards;
+    } else {
+        s->histogram = shards;
+    }
+
+    if (family == family_count) {
+        family_count++;
+    }
+    int id = ++series_count;
+    __atomic_store_n(&series[id], s, __ATOMIC_RELEASE);
+
+    pthread_mutex_unlock(&registry_mutex);
+    return id;
+}
+
+metric_t metrics_counter(const char *name, const char *help, ...) {
+    va_list args;
+    va_start(args, help);
+    metric_t id = register_series(METRIC_COUNTER, name, help, args);
+    va_end(args);
+    return id;
+}
+
+metric_t metrics_gauge(const char *name, const char *help, ...) {
+    va_list args;
+    va_start(args, help);
+    metric_t id = register_series(METRIC_GAUGE, name, help, args);
+    va_end(args);
+    return id;
+}
+
+metric_t metrics_histogram(const char *name, const char *help, ...) {
+    va_list args;
+    va_start(args, help);
+    metric_t id = register_series(METRIC_HISTOGRAM, name, help, args);
+    va_end(args);
+    return id;
+}
+
+void metrics_add(metric_t metric, uint64_t value) {
+    metrics_series_t *s = get_series(metric);
+    if (!s || !s->counter) {
+        return;
+    }
+    atomic_fetch_add_explicit(&s->counter[current_shard()].value, value, memory_order_relaxed);
+}
+
+void metrics_set(metric_t metric, uint64_t value) {
+    metrics_series_t *s = get_series(metric);
+    if (!s || !s->counter) {
+        return;
+    }
+    atomic_store_explicit(&s->counter[0].value, value, memory_order_relaxed);
+}
+
+int metrics_add_collector(void (*collect)(void)) {
+    if (!collect) {
+        return -1;
+    }
+    int slot = atomic_fetch_add(&collector_count, 1);
+    if (slot >= METRICS_MAX_COLLECTORS) {
+        atomic_fetch_sub(&collector_count, 1);
+        log_warn("Too many metrics collectors");
+        return -1;
+    }
+    atomic_store(&collectors[slot], collect);
+    return 0;
+}
+
+void metrics_observe_us(metric_t metric, uint64_t us) {
+    metrics_series_t *s = get_series(metric);
+    if (!s || !s->histogram) {
+        return;
+    }
+
+    histogram_shard_t *shard = &s->histogram[current_shard()];
+    for (int i = 0; i < METRICS_HISTOGRAM_BUCKETS; i++) {
+        if (us <= bucket_bounds_us[i]) {
+            atomic_fetch_add_explicit(&shard->buckets[i], 1, memory_order_relaxed);
+            break;
+        }
+    }
+    atomic_fetch_add_explicit(&shard->sum_us, us, memory_order_relaxed);
+    atomic_fetch_add_explicit(&shard->count, 1, memory_order_relaxed);
+}
+
+uint64_t metrics_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+void metrics_observe_since(metric_t metric, uint64_t start_us) {
+    if (metric <= 0 || start_us == 0) {
+        return;
+    }
+    uint64_t now = metrics_now_us();
+    metrics_observe_us(metric, now > start_us ? now - start_us : 0);
+}
+
+// Growable output buffer
+typedef struct {
+    char *data;
+    size_t len;
+    size_t size;
+    bool failed;
+} metrics_buf_t;
+
+static void buf_printf(metrics_buf_t *b, const char *format, ...) {
+    if (b->failed) {
+        return;
+    }
+
+    for (;;) {
+        va_list args;
+        va_start(args, format);
+        int n = vsnprintf(b->data + b->len, b->size - b->len, format, args);
+        va_end(args);
+
+        if (n < 0) {
+            b->failed = true;
+            return;
+        }
+        if ((size_t)n < b->size - b->len) {
+            b->len += (size_t)n;
+            return;
+        }
+
+        size_t size = b->size * 2;
+        while (size - b->len <= (size_t)n) {
+            size *= 2;
+        }
+        char *data = realloc(b->data, size);
+        if (!data) {
+            b->failed = true;
+            return;
+        }
+        b->data = data;
+        b->size = size;
+    }
+}
+
+// Write one histogram series with cumulative buckets
+static void format_histogram(metrics_buf_t *b, const char *name, const metrics_series_t *s) {
+    uint64_t buckets[METRICS_HISTOGRAM_BUCKETS] = {0};
+    uint64_t count = 0;
+    uint64_t sum_us = 0;
+
+    for (int shard = 0; shard < METRICS_SHARDS; shard++) {
+        const histogram_shard_t *h = &s->histogram[shard];
+        // An observation racing the scrape may be in a bucket but not yet in
+        // count; the +Inf bucket is raised to match below
+        count += atomic_load_explicit(&h->count, memory_order_relaxed);
+        sum_us += atomic_load_explicit(&h->sum_us, memory_order_relaxed);
+        for (int i = 0; i < METRICS_HISTOGRAM_BUCKETS; i++) {
+            buckets[i] += atomic_load_explicit(&h->buckets[i], memory_order_relaxed);
+        }
+    }
+
+    const char *sep = s->labels[0] ? "," : "";
+    uint64_t cumulative = 0;
+    for (int i = 0; i < METRICS_HISTOGRAM_BUCKETS; i++) {
+        cumulative += buckets[i];
+        buf_printf(b, "%s_bucket{%s%sle=\"%s\"} %llu\n", name, s->labels, sep, bucket_labels[i],
+                   (unsigned long long)cumulative);
+    }
+    if (count < cumulative) {
+        count = cumulative;
+    }
+    buf_printf(b, "%s_bucket{%s%sle=\"+Inf\"} %llu\n", name, s->labels, sep, (unsigned long long)count);
+
+    if (s->labels[0]) {
+        buf_printf(b, "%s_sum{%s} %.6f\n", name, s->labels, (double)sum_us / 1000000.0);
+        buf_printf(b, "%s_count{%s} %llu\n", name, s->labels, (unsigned long long)count);
+    } else {
+        buf_printf(b, "%s_sum %.6f\n", name, (double)sum_us / 1000000.0);
+        buf_printf(b, "%s_count %llu\n", name, (unsigned long long)count);
+    }
+}
+
+char *metrics_format(size_t *len) {
+    metrics_buf_t b = { .size = 16384 };
+    b.data = malloc(b.size);
+    if (!b.data) {
+        return NULL;
+    }
+    b.data[0] = '\0';
+
+    // Collectors set gauges, which takes no lock
+    int collector_total = atomic_load(&collector_count);
+    for (int i = 0; i < collector_total && i < METRICS_MAX_COLLECTORS; i++) {
+        void (*collect)(void) = atomic_load(&collectors[i]);
+        if (collect) {
+            collect();
+        }
+    }
+
+    pthread_mutex_lock(&registry_mutex);
+    for (int f = 0; f < family_count; f++) {
+        const metrics_family_t *family = &families[f];
+        buf_printf(&b, "# HELP %s %s\n# TYPE %s %s\n", family->name, family->help, family->name,
+                   family->type == METRIC_COUNTER ? "counter" :
+                   family->type == METRIC_GAUGE ? "gauge" : "histogram");
+
+        for (int id = 1; id <= series_count; id++) {
+            const metrics_series_t *s = series[id];
+            if (s->family != f) {
+                continue;
+            }
+
+            if (family->type == METRIC_HISTOGRAM) {
+                format_histogram(&b, family->name, s);
+                continue;
+            }
+
+            uint64_t value = 0;
+            for (int shard = 0; shard < METRICS_SHARDS; shard++) {
+                value += atomic_load_explicit(&s->counter[shard].value, memory_order_relaxed);
+            }
+            if (s->labels[0]) {
+                buf_printf(&b, "%s{%s} %llu\n", family->name, s->labels, (unsigned long long)value);
+            } else {
+                buf_printf(&b, "%s %llu\n", family->name, (unsigned long long)value);
+            }
+        }
+    }
+    pthread_mutex_unlock(&registry_mutex);
+
+    if (b.failed) {
+        free(b.data);
+        return NULL;
+    }
+    if (len) {
+        *len = b.len;
+    }
+    return b.data;
+}
@@ -0,0 +1,341 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "core/pipeline_trace.h"
+#include "core/config.h"
+#include "core/logger.h"
+
+// Larger demux delays are taken for a PTS discontinuity and restart the estimate
+#define DEMUX_MAX_DELAY_US 10000000LL
+
+// The least delay is tracked over two windows of this length, so a camera
+// clock drifting against ours does not accumulate into the delay
+#define DEMUX_WINDOW_US 60000000LL
+
+// Stream and stage of each registered histogram, for lookups and the event export
+typedef struct {
+    metric_t metric;
+    char stream_name[MAX_STREAM_NAME];
+    char stage[32];
+} trace_series_t;
+
+// One stage of a sampled frame
+typedef struct {
+    metric_t metric;
+    int64_t start_us;
+    int64_t end_us;
+    int64_t pts;
+} trace_event_t;
+
+static pthread_mutex_t series_mutex = PTHREAD_MUTEX_INITIALIZER;
+static trace_series_t trace_series[PIPELINE_TRACE_MAX_SERIES];
+static int trace_series_count = 0;
+
+// Capture window; the end is read without the lock by every stamp
+static pthread_mutex_t capture_mutex = PTHREAD_MUTEX_INITIALIZER;
+static trace_event_t *capture_events = NULL;
+static int capture_event_count = 0;
+static atomic_int_fast64_t capture_end_us;
+static atomic_int capture_every = 1;
+static atomic_uint capture_frames;
+
+static _Thread_local pipeline_trace_t current_trace;
+
+metric_t pipeline_trace_metric(const char *stream_name, const char *stage) {
+    if (!stream_name || !stage) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&series_mutex);
+    for (int i = 0; i < trace_series_count; i++) {
+        if (strcmp(trace_series[i].stage, stage) == 0 && strcmp(trace_series[i].stream_name, stream_name) == 0) {
+            metric_t metric = trace_series[i].metric;
+            pthread_mutex_unlock(&series_mutex);
+            return metric;
+        }
+    }
+
+    if (trace_series_count >= PIPELINE_TRACE_MAX_SERIES) {
+        pthread_mutex_unlock(&series_mutex);
+        return 0;
+    }
+
+    metric_t metric = metrics_histogram("lightnvr_pipeline_latency_seconds",
+                                        "Age of a frame when it reaches a pipeline stage, from its demux",
+                                        "stream", stream_name, "stage", stage, NULL);
+    if (metric != 0) {
+        trace_series_t *s = &trace_series[trace_series_count++];
+        s->metric = metric;
+        snprintf(s->stream_name, sizeof(s->stream_name), "%s", stream_name);
+        snprintf(s->stage, sizeof(s->stage), "%s", stage);
+    }
+    pthread_mutex_unlock(&series_mutex);
+    return metric;
+}
+
+void pipeline_trace_stamp(pipeline_trace_t *trace, int64_t pts, bool is_video) {
+    trace->recv_us = (int64_t)metrics_now_us();
+    trace->pts = pts;
+    trace->sampled = false;
+
+    if (is_video && trace->recv_us < atomic_load_explicit(&capture_end_us, memory_order_relaxed)) {
+        unsigned int frame = atomic_fetch_add_explicit(&capture_frames, 1, memory_order_relaxed);
+        trace->sampled = frame % (unsigned int)atomic_load(&capture_every) == 0;
+    }
+}
+
+/**
+ * Keep one stage of a sampled frame for the capture window
+ */
+static void record_event(metric_t metric, int64_t start_us, int64_t end_us, int64_t pts) {
+    pthread_mutex_lock(&capture_mutex);
+    if (capture_events && capture_event_count < PIPELINE_TRACE_MAX_EVENTS) {
+        trace_event_t *e = &capture_events[capture_event_count++];
+        e->metric = metric;
+        e->start_us = start_us;
+        e->end_us = end_us;
+        e->pts = pts;
+    }
+    pthread_mutex_unlock(&capture_mutex);
+}
+
+void pipeline_trace_stage(metric_t metric, const pipeline_trace_t *trace) {
+    if (metric == 0 || !trace || trace->recv_us == 0) {
+        return;
+    }
+
+    int64_t now = (int64_t)metrics_now_us();
+    metrics_observe_us(metric, now > trace->recv_us ? (uint64_t)(now - trace->recv_us) : 0);
+    if (trace->sampled) {
+        record_event(metric, trace->recv_us, now, trace->pts);
+    }
+}
+
+void pipeline_trace_demux(metric_t metric, pipeline_clock_t *clock, const pipeline_trace_t *trace,
+                          int64_t pts_us) {
+    if (!clock || !trace || trace->recv_us == 0) {
+        return;
+    }
+
+    // Arrival relative to the camera's clock; the least offset seen is a
+    // packet that came without delay
+    int64_t offset = trace->recv_us - pts_us;
+    if (!clock->valid || offset - clock->min_offset_us > DEMUX_MAX_DELAY_US) {
+        clock->min_offset_us = offset;
+        clock->prev_min_offset_us = offset;
+        clock->window_start_us = trace->recv_us;
+        clock->valid = true;
+    }
+    if (trace->recv_us - clock->window_start_us > DEMUX_WINDOW_US) {
+        clock->prev_min_offset_us = clock->min_offset_us;
+        clock->min_offset_us = offset;
+        clock->window_start_us = trace->recv_us;
+    }
+    if (offset < clock->min_offset_us) {
+        clock->min_offset_us = offset;
+    }
+
+    int64_t baseline = clock->min_offset_us < clock->prev_min_offset_us ?
+                       clock->min_offset_us : clock->prev_min_offset_us;
+    int64_t delay = offset > baseline ? offset - baseline : 0;
+
+    metrics_observe_us(metric, (uint64_t)delay);
+    if (trace->sampled && metric != 0) {
+        record_event(metric, trace->recv_us - delay, trace->recv_us, trace->pts);
+    }
+}
+
+void pipeline_trace_set_current(const pipeline_trace_t *trace) {
+    if (trace) {
+        current_trace = *trace;
+    } else {
+        memset(&current_trace, 0, sizeof(current_trace));
+    }
+}
+
+void pipeline_trace_get_current(pipeline_trace_t *trace) {
+    *trace = current_trace;
+}
+
+int pipeline_trace_capture_start(int seconds, int every) {
+    if (seconds <= 0 || seconds > PIPELINE_TRACE_MAX_WINDOW || every <= 0) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&capture_mutex);
+    if (!capture_events) {
+        capture_events = malloc(PIPELINE_TRACE_MAX_EVENTS * sizeof(trace_event_t));
+        if (!capture_events) {
+            pthread_mutex_unlock(&capture_mutex);
+            log_error("Failed to allocate the pipeline trace buffer");
+            return -1;
+        }
+    }
+    capture_event_count = 0;
+    atomic_store(&capture_every, every);
+    atomic_store(&capture_frames, 0);
+    atomic_store(&capture_end_us, (int64_t)metrics_now_us() + (int64_t)seconds * 1000000);
+    pthread_mutex_unlock(&capture_mutex);
+
+    log_info("Capturing pipeline trace events for %d seconds, every %d video frames", seconds, every);
+    return 0;
+}
+
+void pipeline_trace_capture_status(bool *capturing, int *events) {
+    if (capturing) {
+        *capturing = (int64_t)metrics_now_us() < atomic_load(&capture_end_us);
+    }
+    if (events) {
+        pthread_mutex_lock(&capture_mutex);
+        *events = capture_event_count;
+        pthread_mutex_unlock(&capture_mutex);
+    }
+}
+
+// Growable output buffer
+typedef struct {
+    char *data;
+    size_t len;
+    size_t size;
+    bool failed;
+} trace_buf_t;
+
+static void buf_printf(trace_buf_t *b, const char *format, ...) {
+    if (b->failed) {
+        return;
+    }
+
+    for (;;) {
+        va_list args;
+        va_start(args, format);
+        int n = vsnprintf(b->data + b->len, b->size - b->len, format, args);
+        va_end(args);
+
+        if (n < 0) {
+            b->failed = true;
+            return;
+        }
+        if ((size_t)n < b->size - b->len) {
+            b->len += (size_t)n;
+            return;
+        }
+
+        size_t size = b->size * 2;
+        while (size - b->len <= (size_t)n) {
+            size *= 2;
+        }
+        char *data = realloc(b->data, size);
+        if (!data) {
+            b->failed = true;
+            return;
+        }
+        b->data = data;
+        b->size = size;
+    }
+}
+
+// Write a string as a JSON string literal
+static void buf_json_string(trace_buf_t *b, const char *s) {
+    buf_printf(b, "\"");
+    for (const char *p = s; *p; p++) {
+        unsigned char c = (unsigned char)*p;
+        if (c == '"' || c == '\\') {
+            buf_printf(b, "\\%c", c);
+        } else if (c < 0x20) {
+            buf_printf(b, "\\u%04x", c);
+        } else {
+            buf_printf(b, "%c", c);
+        }
+    }
+    buf_printf(b, "\"");
+}
+
+/**
+ * Find the series of a metric among the first count
+ */
+static int find_series(metric_t metric, int count) {
+    for (int i = 0; i < count; i++) {
+        if (trace_series[i].metric == metric) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+char *pipeline_trace_format_events(size_t *len) {
+    trace_buf_t b = { .size = 16384 };
+    b.data = malloc(b.size);
+    if (!b.data) {
+        return NULL;
+    }
+    b.data[0] = '\0';
+
+    pthread_mutex_lock(&series_mutex);
+    int series_count = trace_series_count;
+    pthread_mutex_unlock(&series_mutex);
+
+    bool capturing;
+    pipeline_trace_capture_status(&capturing, NULL);
+
+    buf_printf(&b, "{\"displayTimeUnit\":\"ms\",\"otherData\":{\"capturing\":%s},\"traceEvents\":[",
+               capturing ? "true" : "false");
+
+    // One thread per stream, numbered in the order their first series was
+    // registered and named after it; series are only ever appended, so the
+    // entries below series_count can be read without the lock
+    int tids[PIPELINE_TRACE_MAX_SERIES];
+    int thread_count = 0;
+    bool first = true;
+    for (int i = 0; i < series_count; i++) {
+        tids[i] = 0;
+        for (int j = 0; j < i; j++) {
+            if (strcmp(trace_series[j].stream_name, trace_series[i].stream_name) == 0) {
+                tids[i] = tids[j];
+                break;
+            }
+        }
+        if (tids[i] != 0) {
+            continue;
+        }
+        tids[i] = ++thread_count;
+        buf_printf(&b, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":",
+                   first ? "" : ",", tids[i]);
+        buf_json_string(&b, trace_series[i].stream_name);
+        buf_printf(&b, "}}");
+        first = false;
+    }
+
+    pthread_mutex_lock(&capture_mutex);
+    for (int i = 0; i < capture_event_count; i++) {
+        const trace_event_t *e = &capture_events[i];
+        int series = find_series(e->metric, series_count);
+        if (series < 0) {
+            continue;
+        }
+        buf_printf(&b, "%s{\"name\":", first ? "" : ",");
+        buf_json_string(&b, trace_series[series].stage);
+        buf_printf(&b, ",\"cat\":\"pipeline\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%lld,\"dur\":%lld,"
+                       "\"args\":{\"pts\":%lld}}",
+                   tids[series], (long long)e->start_us, (long long)(e->end_us - e->start_us), (long long)e->pts);
+        first = false;
+    }
+    pthread_mutex_unlock(&capture_mutex);
+
+    buf_printf(&b, "]}\n");
+
+    if (b.failed) {
+        free(b.data);
+        return NULL;
+    }
+    if (len) {
+        *len = b.len;
+    }
+    return b.data;
+}
@@ -0,0 +1,383 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#include "core/profiler.h"
+
+#ifdef ENABLE_PROFILER
+
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <sys/time.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+
+#ifdef HAVE_LIBUNWIND
+#define UNW_LOCAL_ONLY
+#include <libunwind.h>
+#define capture_stack(frames, depth) unw_backtrace((frames), (depth))
+#else
+#include <execinfo.h>
+#define capture_stack(frames, depth) backtrace((frames), (depth))
+#endif
+
+#include "core/logger.h"
+#include "core/shutdown_coordinator.h"
+
+// Frames of the signal handler and the kernel's signal trampoline at the top of every stack
+#define SKIP_FRAMES 2
+
+// Stack of one sample; frames are replaced by symbol IDs when folding
+typedef struct {
+    char thread_name[16];
+    int depth;
+    void *frames[PROFILER_MAX_DEPTH];
+} profile_sample_t;
+
+static atomic_bool profiling = false;        // A profile is running
+static atomic_bool sampling = false;         // The signal handler records samples
+static bool handler_installed = false;       // Only touched by the profiling thread
+static atomic_int handlers_running = 0;
+static atomic_uint sample_count = 0;
+static profile_sample_t *samples = NULL;
+
+/**
+ * SIGPROF handler, records the stack of the interrupted thread
+ * Only async-signal-safe calls: the stack walk, prctl and plain stores.
+ */
+static void profiler_signal_handler(int sig, siginfo_t *info, void *ucontext) {
+    (void)sig;
+    (void)info;
+    (void)ucontext;
+    int saved_errno = errno;
+
+    atomic_fetch_add(&handlers_running, 1);
+    if (atomic_load(&sampling)) {
+        unsigned int slot = atomic_fetch_add(&sample_count, 1);
+        if (slot < PROFILER_MAX_SAMPLES) {
+            profile_sample_t *s = &samples[slot];
+            s->depth = capture_stack(s->frames, PROFILER_MAX_DEPTH);
+            if (prctl(PR_GET_NAME, s->thread_name) != 0) {
+                s->thread_name[0] = '\0';
+            }
+        }
+    }
+    atomic_fetch_sub(&handlers_running, 1);
+
+    errno = saved_errno;
+}
+
+// Growable output buffer
+typedef struct {
+    char *data;
+    size_t len;
+    size_t size;
+    bool failed;
+} fold_buf_t;
+
+static void buf_append(fold_buf_t *b, const char *text, size_t len) {
+    if (b->failed) {
+        return;
+    }
+    if (b->len + len + 1 > b->size) {
+        size_t size = b->size ? b->size * 2 : 65536;
+        while (size < b->len + len + 1) {
+            size *= 2;
+        }
+        char *data = realloc(b->data, size);
+        if (!data) {
+            b->failed = true;
+            return;
+        }
+        b->data = data;
+        b->size = size;
+    }
+    memcpy(b->data + b->len, text, len);
+    b->len += len;
+    b->data[b->len] = '\0';
+}
+
+/**
+ * Copy a frame name, replacing the separators of the folded format
+ */
+static void append_frame_name(fold_buf_t *b, const char *name) {
+    char clean[256];
+    size_t n = 0;
+    for (; name[n] && n < sizeof(clean) - 1; n++) {
+        char c = name[n];
+        clean[n] = (c == ';' || c == ' ' || c == '\n' || c == '\t') ? '_' : c;
+    }
+    buf_append(b, clean, n);
+}
+
+static int compare_pointers(const void *a, const void *b) {
+    uintptr_t x = (uintptr_t)*(void *const *)a;
+    uintptr_t y = (uintptr_t)*(void *const *)b;
+    return x < y ? -1 : x > y;
+}
+
+static int compare_strings(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/**
+ * Order samples by thread name, then stack, so equal stacks are adjacent
+ */
+static int compare_samples(const void *a, const void *b) {
+    const profile_sample_t *x = (const profile_sample_t *)a;
+    const profile_sample_t *y = (const profile_sample_t *)b;
+    int ret = strcmp(x->thread_name, y->thread_name);
+    if (ret != 0) {
+        return ret;
+    }
+    if (x->depth != y->depth) {
+        return x->depth < y->depth ? -1 : 1;
+    }
+    for (int i = 0; i < x->depth; i++) {
+        if (x->frames[i] != y->frames[i]) {
+            return (uintptr_t)x->frames[i] < (uintptr_t)y->frames[i] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Name the function containing an address
+ */
+static char *symbolize(void *addr) {
+    char name[256];
+    Dl_info info;
+    int found = dladdr(addr, &info);
+    if (found && info.dli_sname) {
+        snprintf(name, sizeof(name), "%s", info.dli_sname);
+    } else if (found && info.dli_fname && info.dli_fname[0]) {
+        const char *module = strrchr(info.dli_fname, '/');
+        snprintf(name, sizeof(name), "%s+0x%lx", module ? module + 1 : info.dli_fname,
+                 (unsigned long)((uintptr_t)addr - (uintptr_t)info.dli_fbase));
+    } else {
+        snprintf(name, sizeof(name), "0x%lx", (unsigned long)(uintptr_t)addr);
+    }
+    return strdup(name);
+}
+
+/**
+ * Turn the samples into folded stacks
+ * Frames are symbolized once per distinct address, and addresses within the
+ * same function merged, before equal stacks are counted.
+ */
+static int fold_samples(profile_sample_t *list, int count, profile_result_t *result) {
+    // Drop the handler frames and point return addresses into their call
+    // instruction; the interrupted frame itself is exact
+    size_t total = 0;
+    for (int i = 0; i < count; i++) {
+        profile_sample_t *s = &list[i];
+        int depth = s->depth > SKIP_FRAMES ? s->depth - SKIP_FRAMES : 0;
+        memmove(s->frames, s->frames + SKIP_FRAMES, (size_t)depth * sizeof(void *));
+        s->depth = depth;
+        for (int f = 1; f < depth; f++) {
+            s->frames[f] = (void *)((uintptr_t)s->frames[f] - 1);
+        }
+        if (s->thread_name[0] == '\0') {
+            snprintf(s->thread_name, sizeof(s->thread_name), "unnamed");
+        }
+        total += (size_t)depth;
+    }
+
+    void **addrs = malloc((total ? total : 1) * sizeof(void *));
+    char **names = calloc(total ? total : 1, sizeof(char *));
+    char **sorted_names = malloc((total ? total : 1) * sizeof(char *));
+    int ret = -1;
+    if (!addrs || !names || !sorted_names) {
+        goto out;
+    }
+
+    // Distinct addresses
+    size_t n = 0;
+    for (int i = 0; i < count; i++) {
+        for (int f = 0; f < list[i].depth; f++) {
+            addrs[n++] = list[i].frames[f];
+        }
+    }
+    qsort(addrs, n, sizeof(void *), compare_pointers);
+    size_t unique = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (unique == 0 || addrs[unique - 1] != addrs[i]) {
+            addrs[unique++] = addrs[i];
+        }
+    }
+
+    // Distinct function names; a frame becomes the address of its interned name
+    for (size_t i = 0; i < unique; i++) {
+        names[i] = symbolize(addrs[i]);
+        if (!names[i]) {
+            goto out;
+        }
+        sorted_names[i] = names[i];
+    }
+    qsort(sorted_names, unique, sizeof(char *), compare_strings);
+    size_t unique_names = 0;
+    for (size_t i = 0; i < unique; i++) {
+        if (unique_names == 0 || strcmp(sorted_names[unique_names - 1], sorted_names[i]) != 0) {
+            sorted_names[unique_names++] = sorted_names[i];
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        for (int f = 0; f < list[i].depth; f++) {
+            void **found = bsearch(&list[i].frames[f], addrs, unique, sizeof(void *), compare_pointers);
+            char **name = bsearch(&names[found - addrs], sorted_names, unique_names, sizeof(char *),
+                                  compare_strings);
+            list[i].frames[f] = *name;
+        }
+    }
+
+    qsort(list, (size_t)count, sizeof(profile_sample_t), compare_samples);
+
+    fold_buf_t b = {0};
+    buf_append(&b, "", 0);
+    for (int i = 0; i < count; ) {
+        int run = 1;
+        while (i + run < count && compare_samples(&list[i], &list[i + run]) == 0) {
+            run++;
+        }
+
+        // Root first: thread name, then the outermost frame down to the sampled one
+        append_frame_name(&b, list[i].thread_name);
+        for (int f = list[i].depth - 1; f >= 0; f--) {
+            buf_append(&b, ";", 1);
+            append_frame_name(&b, (const char *)list[i].frames[f]);
+        }
+        char tail[32];
+        int tail_len = snprintf(tail, sizeof(tail), " %d\n", run);
+        buf_append(&b, tail, (size_t)tail_len);
+
+        i += run;
+    }
+
+    if (b.failed) {
+        free(b.data);
+        goto out;
+    }
+    result->folded = b.data;
+    result->len = b.len;
+    ret = 0;
+
+out:
+    if (names) {
+        for (size_t i = 0; i < total && names[i]; i++) {
+            free(names[i]);
+        }
+    }
+    free(names);
+    free(sorted_names);
+    free(addrs);
+    return ret;
+}
+
+bool profiler_available(void) {
+    return true;
+}
+
+int profiler_run(int seconds, int hz, profile_result_t *result) {
+    if (!result || seconds <= 0 || seconds > PROFILER_MAX_SECONDS || hz <= 0 || hz > PROFILER_MAX_HZ) {
+        return -1;
+    }
+    memset(result, 0, sizeof(*result));
+
+    bool expected = false;
+    if (!atomic_compare_exchange_strong(&profiling, &expected, true)) {
+        return PROFILER_ERR_BUSY;
+    }
+
+    samples = calloc(PROFILER_MAX_SAMPLES, sizeof(profile_sample_t));
+    if (!samples) {
+        log_error("Failed to allocate profiler samples");
+        atomic_store(&profiling, false);
+        return -1;
+    }
+
+    // The first stack walk may load the unwinder, which is not safe in a signal handler
+    void *warm[4];
+    capture_stack(warm, 4);
+
+    // The handler stays installed once set: a SIGPROF still pending when a
+    // profile ends would terminate the process under the default action
+    if (!handler_installed) {
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_sigaction = profiler_signal_handler;
+        action.sa_flags = SA_SIGINFO | SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        if (sigaction(SIGPROF, &action, NULL) != 0) {
+            log_error("Failed to install the profiler signal handler: %s", strerror(errno));
+            free(samples);
+            samples = NULL;
+            atomic_store(&profiling, false);
+            return -1;
+        }
+        handler_installed = true;
+    }
+
+    atomic_store(&sample_count, 0);
+    atomic_store(&sampling, true);
+
+    struct itimerval timer;
+    memset(&timer, 0, sizeof(timer));
+    timer.it_interval.tv_sec = 0;
+    timer.it_interval.tv_usec = 1000000 / hz;
+    timer.it_value = timer.it_interval;
+    setitimer(ITIMER_PROF, &timer, NULL);
+
+    log_info("Profiling for %d seconds at %d Hz", seconds, hz);
+    for (int waited_ms = 0; waited_ms < seconds * 1000 && !is_shutdown_initiated(); waited_ms += 100) {
+        usleep(100000);
+    }
+
+    // Stop the timer, then wait out handlers still recording before the samples are read
+    memset(&timer, 0, sizeof(timer));
+    setitimer(ITIMER_PROF, &timer, NULL);
+    atomic_store(&sampling, false);
+    while (atomic_load(&handlers_running) > 0) {
+        usleep(1000);
+    }
+
+    unsigned int taken = atomic_load(&sample_count);
+    int kept = taken < PROFILER_MAX_SAMPLES ? (int)taken : PROFILER_MAX_SAMPLES;
+    result->samples = (int)taken;
+    result->dropped = (int)taken - kept;
+
+    int ret = fold_samples(samples, kept, result);
+    if (ret != 0) {
+        log_error("Failed to fold %d profiler samples", kept);
+    } else {
+        log_info("Profile finished with %u samples (%d dropped)", taken, result->dropped);
+    }
+
+    free(samples);
+    samples = NULL;
+    atomic_store(&profiling, false);
+    return ret;
+}
+
+#else
+
+bool profiler_available(void) {
+    return false;
+}
+
+int profiler_run(int seconds, int hz, profile_result_t *result) {
+    (void)seconds;
+    (void)hz;
+    if (result) {
+        memset(result, 0, sizeof(*result));
+    }
+    return PROFILER_ERR_UNAVAILABLE;
+}
+
+#endif // ENABLE_PROFILER
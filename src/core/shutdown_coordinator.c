@@ -6,6 +6,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <errno.h>
+#include <limits.h>
 #include <time.h>
 #include <sys/time.h>
 
@@ -15,6 +17,11 @@
 // Global shutdown coordinator instance
 static shutdown_coordinator_t g_coordinator;
 
+// Milliseconds from one monotonic time to another
+static long diff_ms(const struct timespec *from, const struct timespec *to) {
+    return (long)(to->tv_sec - from->tv_sec) * 1000 + (to->tv_nsec - from->tv_nsec) / 1000000;
+}
+
 // Initialize the shutdown coordinator
 int init_shutdown_coordinator(void) {
     memset(&g_coordinator, 0, sizeof(shutdown_coordinator_t));
@@ -27,11 +34,19 @@ int init_shutdown_coordinator(void) {
         return -1;
     }
     
-    if (pthread_cond_init(&g_coordinator.all_stopped_cond, NULL) != 0) {
+    // Deadlines are taken from the monotonic clock, so clock changes cannot stretch shutdown
+    pthread_condattr_t cond_attr;
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+
+    if (pthread_cond_init(&g_coordinator.all_stopped_cond, &cond_attr) != 0 ||
+        pthread_cond_init(&g_coordinator.state_changed_cond, &cond_attr) != 0) {
         log_error("Failed to initialize shutdown coordinator condition variable");
+        pthread_condattr_destroy(&cond_attr);
         pthread_mutex_destroy(&g_coordinator.mutex);
         return -1;
     }
+    pthread_condattr_destroy(&cond_attr);
     
     g_coordinator.all_components_stopped = false;
     
@@ -43,6 +58,7 @@ int init_shutdown_coordinator(void) {
 void shutdown_coordinator_cleanup(void) {
     pthread_mutex_destroy(&g_coordinator.mutex);
     pthread_cond_destroy(&g_coordinator.all_stopped_cond);
+    pthread_cond_destroy(&g_coordinator.state_changed_cond);
     log_info("Shutdown coordinator cleaned up");
 }
 
@@ -99,6 +115,14 @@ void update_component_state(int component_id, component_state_t state) {
     // If the component is now stopped, check if all components are stopped
     if (state == COMPONENT_STOPPED) {
         pthread_mutex_lock(&g_coordinator.mutex);
+
+        if (atomic_load(&g_coordinator.shutdown_initiated)) {
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            log_info("Component %s stopped %ld ms after shutdown was initiated",
+                     component->name, diff_ms(&g_coordinator.shutdown_started, &now));
+        }
+        pthread_cond_broadcast(&g_coordinator.state_changed_cond);
         
         // Check if all components are stopped
         bool all_stopped = true;
@@ -132,6 +156,7 @@ component_state_t get_component_state(int component_id) {
 // Initiate shutdown sequence
 void initiate_shutdown(void) {
     // Set the shutdown flag
+    clock_gettime(CLOCK_MONOTONIC, &g_coordinator.shutdown_started);
     atomic_store(&g_coordinator.shutdown_initiated, true);
     
     log_info("Shutdown sequence initiated");
@@ -185,94 +210,113 @@ bool is_shutdown_initiated(void) {
     return atomic_load(&g_coordinator.shutdown_initiated);
 }
 
+// Get a deadline timeout_ms from now
+void get_shutdown_deadline(int timeout_ms, struct timespec *deadline) {
+    clock_gettime(CLOCK_MONOTONIC, deadline);
+    deadline->tv_sec += timeout_ms / 1000;
+    deadline->tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+    if (deadline->tv_nsec >= 1000000000) {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000;
+    }
+}
+
+/**
+ * Count the components of a tier that have not stopped, and list their names
+ * Called with the coordinator mutex held.
+ */
+static int list_pending_components(int min_priority, char *names, size_t size) {
+    int pending = 0;
+    size_t len = 0;
+
+    names[0] = '\0';
+    for (int i = 0; i < atomic_load(&g_coordinator.component_count); i++) {
+        component_info_t *component = &g_coordinator.components[i];
+        if (component->priority < min_priority || atomic_load(&component->state) == COMPONENT_STOPPED) {
+            continue;
+        }
+        if (len < size) {
+            int n = snprintf(names + len, size - len, "%s%s", pending > 0 ? ", " : "", component->name);
+            len += n > 0 ? (size_t)n : 0;
+        }
+        pending++;
+    }
+    return pending;
+}
+
+// Wait until every component with at least min_priority has stopped
+bool wait_for_components_stopped(int min_priority, const struct timespec *deadline) {
+    char pending_names[512];
+    bool report = true;
+
+    pthread_mutex_lock(&g_coordinator.mutex);
+
+    for (;;) {
+        int pending = list_pending_components(min_priority, pending_names, sizeof(pending_names));
+        if (pending == 0) {
+            pthread_mutex_unlock(&g_coordinator.mutex);
+            return true;
+        }
+
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        long remaining_ms = diff_ms(&now, deadline);
+        if (remaining_ms <= 0) {
+            log_warn("%d components did not stop in time: %s", pending, pending_names);
+            pthread_mutex_unlock(&g_coordinator.mutex);
+            return false;
+        }
+
+        if (report) {
+            log_info("Waiting for %d components to stop (%ld ms left): %s",
+                     pending, remaining_ms, pending_names);
+        }
+
+        // Wake up at least once a second to report progress
+        struct timespec wake = now;
+        wake.tv_sec++;
+        if (remaining_ms < 1000) {
+            wake = *deadline;
+        }
+        report = pthread_cond_timedwait(&g_coordinator.state_changed_cond,
+                                        &g_coordinator.mutex, &wake) == ETIMEDOUT;
+    }
+}
+
 // Wait for all components to stop (with timeout)
 bool wait_for_all_components_stopped(int timeout_seconds) {
-    struct timespec timeout;
-    clock_gettime(CLOCK_REALTIME, &timeout);
-    timeout.tv_sec += timeout_seconds;
-    
-    pthread_mutex_lock(&g_coordinator.mutex);
-    
-    // If all components are already stopped, return immediately
-    if (g_coordinator.all_components_stopped) {
+    struct timespec deadline;
+    get_shutdown_deadline(timeout_seconds * 1000, &deadline);
+
+    if (wait_for_components_stopped(INT_MIN, &deadline)) {
+        pthread_mutex_lock(&g_coordinator.mutex);
+        g_coordinator.all_components_stopped = true;
         pthread_mutex_unlock(&g_coordinator.mutex);
+        log_info("All components are now in stopped state");
         return true;
     }
-    
-    // First, log which components are still not stopped
-    log_info("Waiting for components to stop (timeout: %d seconds):", timeout_seconds);
+
+    pthread_mutex_lock(&g_coordinator.mutex);
+
+    // Force the stragglers to be marked as stopped so cleanup can continue
+    log_warn("Timeout waiting for all components to stop, forcing all components to stopped state");
     for (int i = 0; i < atomic_load(&g_coordinator.component_count); i++) {
         component_state_t state = atomic_load(&g_coordinator.components[i].state);
         if (state != COMPONENT_STOPPED) {
-            log_info("Component %s (ID: %d) is in state %d", 
+            log_warn("Forcing component %s (ID: %d) from state %d to STOPPED",
                      g_coordinator.components[i].name, i, state);
+            atomic_store(&g_coordinator.components[i].state, COMPONENT_STOPPED);
         }
     }
-    
-    // Wait for the condition with timeout
-    int result = pthread_cond_timedwait(&g_coordinator.all_stopped_cond, 
-                                        &g_coordinator.mutex, &timeout);
-    
-    bool all_stopped = g_coordinator.all_components_stopped;
-    
-    // If we timed out, force all components to be marked as stopped
-    if (result != 0 || !all_stopped) {
-        log_warn("Timeout waiting for all components to stop, forcing all components to stopped state");
-        
-        // Force all components to be marked as stopped
-        for (int i = 0; i < atomic_load(&g_coordinator.component_count); i++) {
-            component_state_t state = atomic_load(&g_coordinator.components[i].state);
-            if (state != COMPONENT_STOPPED) {
-                log_warn("Forcing component %s (ID: %d) from state %d to STOPPED", 
-                         g_coordinator.components[i].name, i, state);
-                atomic_store(&g_coordinator.components[i].state, COMPONENT_STOPPED);
-                
-                // If this is a WebSocket component, try to force close it
-                if (strstr(g_coordinator.components[i].name, "websocket") != NULL) {
-                    log_warn("Forcing close of WebSocket component: %s", g_coordinator.components[i].name);
-                    // The context pointer might be a mg_connection, but we can't safely use it
-                    // Just mark it as stopped and let the cleanup continue
-                }
-                
-                // If this is an HLS writer component, try to force close it
-                if (strstr(g_coordinator.components[i].name, "hls_writer") != NULL ||
-                    strstr(g_coordinator.components[i].name, "hls_manager") != NULL) {
-                    log_warn("Forcing close of HLS component: %s", g_coordinator.components[i].name);
-                    // We can't safely access the context here, just mark it as stopped
-                }
-            }
-        }
-        
-        // Mark all components as stopped
-        g_coordinator.all_components_stopped = true;
-        all_stopped = true;
-        
-        // Signal the condition in case any other threads are waiting
-        pthread_cond_broadcast(&g_coordinator.all_stopped_cond);
-    }
-    
+
+    g_coordinator.all_components_stopped = true;
+
+    // Signal the condition in case any other threads are waiting
+    pthread_cond_broadcast(&g_coordinator.all_stopped_cond);
+    pthread_cond_broadcast(&g_coordinator.state_changed_cond);
+
     pthread_mutex_unlock(&g_coordinator.mutex);
-    
-    if (all_stopped) {
-        log_info("All components are now in stopped state");
-        return true;
-    } else {
-        // This should never happen now, but keep as a fallback
-        log_error("Failed to mark all components as stopped, this is unexpected");
-        
-        // Log which components are still not stopped
-        pthread_mutex_lock(&g_coordinator.mutex);
-        for (int i = 0; i < atomic_load(&g_coordinator.component_count); i++) {
-            component_state_t state = atomic_load(&g_coordinator.components[i].state);
-            if (state != COMPONENT_STOPPED) {
-                log_error("Component %s (ID: %d) is still in state %d", 
-                         g_coordinator.components[i].name, i, state);
-            }
-        }
-        pthread_mutex_unlock(&g_coordinator.mutex);
-        
-        return false;
-    }
+    return false;
 }
 
 // Get the global shutdown coordinator instance
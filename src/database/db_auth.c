@@ -12,6 +12,7 @@
 #include <stddef.h>
 #include <unistd.h>
 #include <sys/time.h>
+#include <pthread.h>
 
 #include "database/db_auth.h"
 #include "database/db_core.h"
@@ -32,6 +33,36 @@
 // Default session expiry time (24 hours)
 #define DEFAULT_SESSION_EXPIRY 86400
 
+// Validated sessions and API keys are remembered for at most this many seconds
+#define AUTH_CACHE_TTL 60
+
+// Slots of the validation cache; a key may live in AUTH_CACHE_WAYS consecutive slots
+#define AUTH_CACHE_SLOTS 256
+#define AUTH_CACHE_WAYS 4
+
+typedef enum {
+    AUTH_CACHE_EMPTY = 0,
+    AUTH_CACHE_SESSION,
+    AUTH_CACHE_API_KEY
+} auth_cache_kind_t;
+
+// Entry of the validation cache; seq is odd while the entry is written
+typedef struct {
+    uint32_t seq;
+    auth_cache_kind_t kind;
+    uint64_t hash;
+    char key[128];
+    time_t expires_at;
+    user_t user;             // Only the ID is set for sessions
+} auth_cache_entry_t;
+
+// Readers never lock; writers serialize on cache_write_mutex
+static auth_cache_entry_t auth_cache[AUTH_CACHE_SLOTS];
+static pthread_mutex_t cache_write_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Bumped by every invalidation, so a lookup that raced with one is not stored
+static uint64_t cache_generation = 0;
+
 // Role names
 static const char *role_names[] = {
     "admin",
@@ -40,6 +71,140 @@ static const char *role_names[] = {
     "api"
 };
 
+static uint64_t auth_cache_hash(auth_cache_kind_t kind, const char *key) {
+    uint64_t hash = 14695981039346656037ULL ^ (uint64_t)kind;
+    for (const unsigned char *p = (const unsigned char *)key; *p; p++) {
+        hash = (hash ^ *p) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+/**
+ * Look up a validated session or API key without taking a lock
+ *
+ * @param kind What key is
+ * @param key Session token or API key
+ * @param user Receives the cached user
+ * @return true if a live entry was found
+ */
+static bool auth_cache_lookup(auth_cache_kind_t kind, const char *key, user_t *user) {
+    if (strlen(key) >= sizeof(auth_cache[0].key)) {
+        return false;
+    }
+
+    uint64_t hash = auth_cache_hash(kind, key);
+    time_t now = time(NULL);
+
+    for (int way = 0; way < AUTH_CACHE_WAYS; way++) {
+        auth_cache_entry_t *entry = &auth_cache[(hash + way) % AUTH_CACHE_SLOTS];
+
+        uint32_t seq = __atomic_load_n(&entry->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1) {
+            continue;
+        }
+        if (entry->kind != kind || entry->hash != hash || entry->expires_at < now ||
+            strncmp(entry->key, key, sizeof(entry->key)) != 0) {
+            continue;
+        }
+        user_t copy = entry->user;
+
+        // The entry was rewritten while it was read
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&entry->seq, __ATOMIC_RELAXED) != seq) {
+            continue;
+        }
+        *user = copy;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Remember a validated session or API key
+ *
+ * @param generation cache_generation read before the database was queried
+ */
+static void auth_cache_store(auth_cache_kind_t kind, const char *key, const user_t *user,
+                             time_t expires_at, uint64_t generation) {
+    if (strlen(key) >= sizeof(auth_cache[0].key)) {
+        return;
+    }
+
+    uint64_t hash = auth_cache_hash(kind, key);
+    time_t now = time(NULL);
+    if (expires_at > now + AUTH_CACHE_TTL) {
+        expires_at = now + AUTH_CACHE_TTL;
+    }
+
+    pthread_mutex_lock(&cache_write_mutex);
+    if (generation != cache_generation) {
+        pthread_mutex_unlock(&cache_write_mutex);
+        return;
+    }
+
+    // Take the first empty or expired way, else the one that expires first
+    auth_cache_entry_t *victim = NULL;
+    for (int way = 0; way < AUTH_CACHE_WAYS; way++) {
+        auth_cache_entry_t *entry = &auth_cache[(hash + way) % AUTH_CACHE_SLOTS];
+        if (entry->kind == AUTH_CACHE_EMPTY || entry->expires_at < now) {
+            victim = entry;
+            break;
+        }
+        if (!victim || entry->expires_at < victim->expires_at) {
+            victim = entry;
+        }
+    }
+
+    uint32_t seq = __atomic_load_n(&victim->seq, __ATOMIC_RELAXED);
+    __atomic_store_n(&victim->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    victim->kind = kind;
+    victim->hash = hash;
+    strncpy(victim->key, key, sizeof(victim->key) - 1);
+    victim->key[sizeof(victim->key) - 1] = '\0';
+    victim->expires_at = expires_at;
+    victim->user = *user;
+
+    __atomic_store_n(&victim->seq, seq + 2, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&cache_write_mutex);
+}
+
+static uint64_t auth_cache_generation(void) {
+    return __atomic_load_n(&cache_generation, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * Forget cached entries of a session token or of a user
+ *
+ * @param token Session token to forget, or NULL
+ * @param user_id User whose entries to forget, or -1 for none
+ */
+static void auth_cache_invalidate(const char *token, int64_t user_id) {
+    pthread_mutex_lock(&cache_write_mutex);
+    __atomic_store_n(&cache_generation, cache_generation + 1, __ATOMIC_RELEASE);
+
+    for (int i = 0; i < AUTH_CACHE_SLOTS; i++) {
+        auth_cache_entry_t *entry = &auth_cache[i];
+        if (entry->kind == AUTH_CACHE_EMPTY) {
+            continue;
+        }
+        bool match = (user_id >= 0 && entry->user.id == user_id) ||
+                     (token && entry->kind == AUTH_CACHE_SESSION &&
+                      strncmp(entry->key, token, sizeof(entry->key)) == 0);
+        if (!match) {
+            continue;
+        }
+
+        uint32_t seq = __atomic_load_n(&entry->seq, __ATOMIC_RELAXED);
+        __atomic_store_n(&entry->seq, seq + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        entry->kind = AUTH_CACHE_EMPTY;
+        __atomic_store_n(&entry->seq, seq + 2, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&cache_write_mutex);
+}
+
 /**
  * Generate a random string
  * 
@@ -429,6 +594,9 @@ int db_auth_update_user(int64_t user_id, const char *email, int role, int is_act
     
     sqlite3_finalize(stmt);
     
+    // Role or active state may have changed
+    auth_cache_invalidate(NULL, user_id);
+    
     log_info("User updated successfully: %lld", (long long)user_id);
     return 0;
 }
@@ -543,6 +711,8 @@ int db_auth_change_password(int64_t user_id, const char *new_password) {
     
     sqlite3_finalize(stmt);
     
+    auth_cache_invalidate(NULL, user_id);
+    
     log_info("Password changed successfully for user: %lld", (long long)user_id);
     return 0;
 }
@@ -593,6 +763,8 @@ int db_auth_delete_user(int64_t user_id) {
     
     sqlite3_finalize(stmt);
     
+    auth_cache_invalidate(NULL, user_id);
+    
     log_info("User deleted successfully: %lld", (long long)user_id);
     return 0;
 }
@@ -613,14 +785,15 @@ int db_auth_get_user_by_id(int64_t user_id, user_t *user) {
     }
     
     // Query the user
-    sqlite3_stmt *stmt;
-    int rc = sqlite3_prepare_v2(db,
-                               "SELECT id, username, email, role, api_key, created_at, "
-                               "updated_at, last_login, is_active "
-                               "FROM users WHERE id = ?;",
-                               -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
-        log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+    // Cached statements are shared, so they are only used under the database mutex
+    pthread_mutex_t *db_mutex = get_db_mutex();
+    lock_db_mutex();
+    sqlite3_stmt *stmt = get_cached_stmt(DB_STMT_USER_BY_ID,
+                                         "SELECT id, username, email, role, api_key, created_at, "
+                                         "updated_at, last_login, is_active "
+                                         "FROM users WHERE id = ?;");
+    if (!stmt) {
+        pthread_mutex_unlock(db_mutex);
         return -1;
     }
     
@@ -628,7 +801,8 @@ int db_auth_get_user_by_id(int64_t user_id, user_t *user) {
     
     if (sqlite3_step(stmt) != SQLITE_ROW) {
         log_error("User not found: %lld", (long long)user_id);
-        sqlite3_finalize(stmt);
+        release_cached_stmt(stmt);
+        pthread_mutex_unlock(db_mutex);
         return -1;
     }
     
@@ -660,7 +834,8 @@ int db_auth_get_user_by_id(int64_t user_id, user_t *user) {
     user->last_login = sqlite3_column_int64(stmt, 7);
     user->is_active = sqlite3_column_int(stmt, 8) != 0;
     
-    sqlite3_finalize(stmt);
+    release_cached_stmt(stmt);
+    pthread_mutex_unlock(db_mutex);
     
     return 0;
 }
@@ -681,14 +856,14 @@ int db_auth_get_user_by_username(const char *username, user_t *user) {
     }
     
     // Query the user
-    sqlite3_stmt *stmt;
-    int rc = sqlite3_prepare_v2(db,
-                               "SELECT id, username, email, role, api_key, created_at, "
-                               "updated_at, last_login, is_active "
-                               "FROM users WHERE username = ?;",
-                               -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
-        log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+    pthread_mutex_t *db_mutex = get_db_mutex();
+    lock_db_mutex();
+    sqlite3_stmt *stmt = get_cached_stmt(DB_STMT_USER_BY_USERNAME,
+                                         "SELECT id, username, email, role, api_key, created_at, "
+                                         "updated_at, last_login, is_active "
+                                         "FROM users WHERE username = ?;");
+    if (!stmt) {
+        pthread_mutex_unlock(db_mutex);
         return -1;
     }
     
@@ -696,7 +871,8 @@ int db_auth_get_user_by_username(const char *username, user_t *user) {
     
     if (sqlite3_step(stmt) != SQLITE_ROW) {
         log_debug("User not found: %s", username);
-        sqlite3_finalize(stmt);
+        release_cached_stmt(stmt);
+        pthread_mutex_unlock(db_mutex);
         return -1;
     }
     
@@ -728,7 +904,8 @@ int db_auth_get_user_by_username(const char *username, user_t *user) {
     user->last_login = sqlite3_column_int64(stmt, 7);
     user->is_active = sqlite3_column_int(stmt, 8) != 0;
     
-    sqlite3_finalize(stmt);
+    release_cached_stmt(stmt);
+    pthread_mutex_unlock(db_mutex);
     
     return 0;
 }
@@ -742,6 +919,11 @@ int db_auth_get_user_by_api_key(const char *api_key, user_t *user) {
         return -1;
     }
     
+    // Keys checked in the last AUTH_CACHE_TTL seconds skip the database
+    if (auth_cache_lookup(AUTH_CACHE_API_KEY, api_key, user)) {
+        return 0;
+    }
+    
     sqlite3 *db = get_db_handle();
     if (!db) {
         log_error("Database not initialized");
@@ -749,14 +931,15 @@ int db_auth_get_user_by_api_key(const char *api_key, user_t *user) {
     }
     
     // Query the user
-    sqlite3_stmt *stmt;
-    int rc = sqlite3_prepare_v2(db,
-                               "SELECT id, username, email, role, api_key, created_at, "
-                               "updated_at, last_login, is_active "
-                               "FROM users WHERE api_key = ?;",
-                               -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
-        log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+    uint64_t generation = auth_cache_generation();
+    pthread_mutex_t *db_mutex = get_db_mutex();
+    lock_db_mutex();
+    sqlite3_stmt *stmt = get_cached_stmt(DB_STMT_USER_BY_API_KEY,
+                                         "SELECT id, username, email, role, api_key, created_at, "
+                                         "updated_at, last_login, is_active "
+                                         "FROM users WHERE api_key = ?;");
+    if (!stmt) {
+        pthread_mutex_unlock(db_mutex);
         return -1;
     }
     
@@ -764,7 +947,8 @@ int db_auth_get_user_by_api_key(const char *api_key, user_t *user) {
     
     if (sqlite3_step(stmt) != SQLITE_ROW) {
         log_debug("User not found for API key");
-        sqlite3_finalize(stmt);
+        release_cached_stmt(stmt);
+        pthread_mutex_unlock(db_mutex);
         return -1;
     }
     
@@ -796,8 +980,10 @@ int db_auth_get_user_by_api_key(const char *api_key, user_t *user) {
     user->last_login = sqlite3_column_int64(stmt, 7);
     user->is_active = sqlite3_column_int(stmt, 8) != 0;
     
-    sqlite3_finalize(stmt);
+    release_cached_stmt(stmt);
+    pthread_mutex_unlock(db_mutex);
     
+    auth_cache_store(AUTH_CACHE_API_KEY, api_key, user, time(NULL) + AUTH_CACHE_TTL, generation);
     return 0;
 }
 
@@ -863,6 +1049,9 @@ int db_auth_generate_api_key(int64_t user_id, char *api_key, size_t api_key_size
     
     sqlite3_finalize(stmt);
     
+    // The old key must stop working right away
+    auth_cache_invalidate(NULL, user_id);
+    
     log_info("API key generated successfully for user: %lld", (long long)user_id);
     return 0;
 }
@@ -1068,6 +1257,15 @@ int db_auth_validate_session(const char *token, int64_t *user_id) {
         return -1;
     }
     
+    // Sessions validated in the last AUTH_CACHE_TTL seconds skip the database
+    user_t cached;
+    if (auth_cache_lookup(AUTH_CACHE_SESSION, token, &cached)) {
+        if (user_id) {
+            *user_id = cached.id;
+        }
+        return 0;
+    }
+    
     sqlite3 *db = get_db_handle();
     if (!db) {
         log_error("Database not initialized");
@@ -1075,15 +1273,16 @@ int db_auth_validate_session(const char *token, int64_t *user_id) {
     }
     
     // Query the session
-    sqlite3_stmt *stmt;
-    int rc = sqlite3_prepare_v2(db,
-                               "SELECT s.id, s.user_id, s.expires_at, u.is_active "
-                               "FROM sessions s "
-                               "JOIN users u ON s.user_id = u.id "
-                               "WHERE s.token = ?;",
-                               -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
-        log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+    uint64_t generation = auth_cache_generation();
+    pthread_mutex_t *db_mutex = get_db_mutex();
+    lock_db_mutex();
+    sqlite3_stmt *stmt = get_cached_stmt(DB_STMT_SESSION_VALIDATE,
+                                         "SELECT s.id, s.user_id, s.expires_at, u.is_active "
+                                         "FROM sessions s "
+                                         "JOIN users u ON s.user_id = u.id "
+                                         "WHERE s.token = ?;");
+    if (!stmt) {
+        pthread_mutex_unlock(db_mutex);
         return -1;
     }
     
@@ -1091,7 +1290,8 @@ int db_auth_validate_session(const char *token, int64_t *user_id) {
     
     if (sqlite3_step(stmt) != SQLITE_ROW) {
         log_debug("Session not found for token");
-        sqlite3_finalize(stmt);
+        release_cached_stmt(stmt);
+        pthread_mutex_unlock(db_mutex);
         return -1;
     }
     
@@ -1101,7 +1301,8 @@ int db_auth_validate_session(const char *token, int64_t *user_id) {
     
     if (now > expires_at) {
         log_debug("Session has expired");
-        sqlite3_finalize(stmt);
+        release_cached_stmt(stmt);
+        pthread_mutex_unlock(db_mutex);
         return -1;
     }
     
@@ -1109,7 +1310,8 @@ int db_auth_validate_session(const char *token, int64_t *user_id) {
     int is_active = sqlite3_column_int(stmt, 3);
     if (!is_active) {
         log_debug("User is inactive");
-        sqlite3_finalize(stmt);
+        release_cached_stmt(stmt);
+        pthread_mutex_unlock(db_mutex);
         return -1;
     }
     
@@ -1119,8 +1321,13 @@ int db_auth_validate_session(const char *token, int64_t *user_id) {
         *user_id = id;
     }
     
-    sqlite3_finalize(stmt);
+    release_cached_stmt(stmt);
+    pthread_mutex_unlock(db_mutex);
     
+    memset(&cached, 0, sizeof(cached));
+    cached.id = id;
+    cached.is_active = true;
+    auth_cache_store(AUTH_CACHE_SESSION, token, &cached, expires_at, generation);
     return 0;
 }
 
@@ -1158,6 +1365,8 @@ int db_auth_delete_session(const char *token) {
     
     sqlite3_finalize(stmt);
     
+    auth_cache_invalidate(token, -1);
+    
     log_info("Session deleted successfully");
     return 0;
 }
@@ -1191,6 +1400,8 @@ int db_auth_delete_user_sessions(int64_t user_id) {
     
     sqlite3_finalize(stmt);
     
+    auth_cache_invalidate(NULL, user_id);
+    
     log_info("Sessions deleted successfully for user: %lld", (long long)user_id);
     return 0;
 }
@@ -20,84 +20,463 @@
 #include "database/db_schema_utils.h"
 #include "core/logger.h"
 
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+// Pages copied per sqlite3_backup_step() call, 4 MB with 4 KB pages
+#define BACKUP_PAGES_PER_STEP 1024
+// Pause of a background backup after each step, leaving the disk to recording
+#define BACKUP_STEP_PAUSE_MS 50
+// Bytes compressed between two pauses of a background backup
+#define BACKUP_COMPRESS_CHUNK (1024 * 1024)
+// Least time between two progress reports
+#define BACKUP_REPORT_INTERVAL_MS 500
+
 // Flag to indicate if a backup is in progress
 static bool backup_in_progress = false;
+static pthread_mutex_t backup_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t backup_cond = PTHREAD_COND_INITIALIZER;
 
-// Backup the database to a specified path
-int backup_database(const char *source_path, const char *dest_path) {
+// Background backup
+static pthread_t backup_thread;
+static bool backup_thread_started = false;
+static bool backup_stopping = false;
+static char backup_source[1024];
+static bool backup_compress = false;
+static db_backup_status_t backup_status;
+static db_backup_progress_fn progress_fn = NULL;
+static struct timespec last_report;
+
+const char *backup_state_name(db_backup_state_t state) {
+    switch (state) {
+        case DB_BACKUP_IDLE:        return "idle";
+        case DB_BACKUP_COPYING:     return "copying";
+        case DB_BACKUP_COMPRESSING: return "compressing";
+        case DB_BACKUP_DONE:        return "done";
+        case DB_BACKUP_FAILED:      return "failed";
+        case DB_BACKUP_ABORTED:     return "aborted";
+    }
+    return "unknown";
+}
+
+// Claim the single backup slot
+static bool begin_backup(void) {
+    pthread_mutex_lock(&backup_mutex);
+    bool claimed = !backup_in_progress;
+    backup_in_progress = true;
+    pthread_mutex_unlock(&backup_mutex);
+    return claimed;
+}
+
+static void end_backup(void) {
+    pthread_mutex_lock(&backup_mutex);
+    backup_in_progress = false;
+    pthread_mutex_unlock(&backup_mutex);
+}
+
+// Wait up to ms milliseconds, returns true if a stop was requested
+static bool backup_pause(int ms) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += ms / 1000;
+    deadline.tv_nsec += (long)(ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&backup_mutex);
+    while (!backup_stopping) {
+        if (pthread_cond_timedwait(&backup_cond, &backup_mutex, &deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+    bool stopping = backup_stopping;
+    pthread_mutex_unlock(&backup_mutex);
+    return stopping;
+}
+
+// Update the background backup status and report it, at most every
+// BACKUP_REPORT_INTERVAL_MS unless forced
+static void report_progress(db_backup_state_t state, int pages_done, int pages_total,
+                            const char *message, bool force) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    pthread_mutex_lock(&backup_mutex);
+    backup_status.state = state;
+    backup_status.pages_done = pages_done;
+    backup_status.pages_total = pages_total;
+    if (message) {
+        snprintf(backup_status.message, sizeof(backup_status.message), "%s", message);
+    }
+    if (state >= DB_BACKUP_DONE) {
+        backup_status.finished_at = time(NULL);
+    }
+
+    long elapsed_ms = (now.tv_sec - last_report.tv_sec) * 1000 +
+                      (now.tv_nsec - last_report.tv_nsec) / 1000000;
+    bool report = progress_fn && (force || elapsed_ms >= BACKUP_REPORT_INTERVAL_MS);
+    db_backup_status_t snapshot = backup_status;
+    db_backup_progress_fn fn = progress_fn;
+    if (report) {
+        last_report = now;
+    }
+    pthread_mutex_unlock(&backup_mutex);
+
+    if (report) {
+        fn(&snapshot);
+    }
+}
+
+/**
+ * Copy a database page batch by page batch
+ *
+ * In WAL mode the source keeps one read transaction for the whole copy, so
+ * the copy is of one snapshot and is not restarted by every commit of the
+ * writer. Writers are not blocked by it; checkpoints only cannot go past
+ * the snapshot until the copy is done.
+ *
+ * @param background Pause between steps and report progress
+ */
+static int copy_database(const char *source_path, const char *dest_path, bool background) {
     int rc;
     sqlite3 *source_db = NULL;
     sqlite3 *dest_db = NULL;
     sqlite3_backup *backup = NULL;
-    
-    if (backup_in_progress) {
-        log_warn("Backup already in progress, skipping");
-        return -1;
-    }
-    
-    backup_in_progress = true;
-    
-    log_info("Starting database backup from %s to %s", source_path, dest_path);
-    
+    bool snapshot = false;
+
     // Open the source database
-    rc = sqlite3_open_v2(source_path, &source_db, SQLITE_OPEN_READONLY, NULL);
+    rc = sqlite3_open_v2(source_path, &source_db, SQLITE_OPEN_READONLY | SQLITE_OPEN_PRIVATECACHE, NULL);
     if (rc != SQLITE_OK) {
         log_error("Failed to open source database for backup: %s", sqlite3_errmsg(source_db));
         sqlite3_close(source_db);
-        backup_in_progress = false;
         return -1;
     }
-    
+    sqlite3_busy_timeout(source_db, 5000);
+
+    // The copy goes to a temporary file, so a failed one leaves the previous backup
+    char tmp_path[1100];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", dest_path);
+    unlink(tmp_path);
+
     // Open the destination database
-    rc = sqlite3_open_v2(dest_path, &dest_db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, NULL);
+    rc = sqlite3_open_v2(tmp_path, &dest_db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, NULL);
     if (rc != SQLITE_OK) {
         log_error("Failed to open destination database for backup: %s", sqlite3_errmsg(dest_db));
         sqlite3_close(source_db);
         sqlite3_close(dest_db);
-        backup_in_progress = false;
         return -1;
     }
-    
+    // The file is only renamed into place once complete, so it needs no journal
+    sqlite3_exec(dest_db, "PRAGMA journal_mode=OFF; PRAGMA synchronous=OFF;", NULL, NULL, NULL);
+
+    sqlite3_stmt *stmt = NULL;
+    if (sqlite3_prepare_v2(source_db, "PRAGMA journal_mode;", -1, &stmt, NULL) == SQLITE_OK &&
+        sqlite3_step(stmt) == SQLITE_ROW) {
+        const char *mode = (const char *)sqlite3_column_text(stmt, 0);
+        snapshot = mode && strcmp(mode, "wal") == 0;
+    }
+    sqlite3_finalize(stmt);
+
+    // Outside WAL mode a read transaction would hold up writers instead
+    if (snapshot && (sqlite3_exec(source_db, "BEGIN", NULL, NULL, NULL) != SQLITE_OK ||
+                     sqlite3_exec(source_db, "SELECT count(*) FROM sqlite_master", NULL, NULL, NULL) != SQLITE_OK)) {
+        log_warn("Failed to start backup snapshot, copy may restart on changes: %s", sqlite3_errmsg(source_db));
+        sqlite3_exec(source_db, "ROLLBACK", NULL, NULL, NULL);
+        snapshot = false;
+    }
+
     // Initialize the backup
     backup = sqlite3_backup_init(dest_db, "main", source_db, "main");
     if (!backup) {
         log_error("Failed to initialize backup: %s", sqlite3_errmsg(dest_db));
         sqlite3_close(source_db);
         sqlite3_close(dest_db);
-        backup_in_progress = false;
+        unlink(tmp_path);
         return -1;
     }
-    
+
     // Perform the backup
-    rc = sqlite3_backup_step(backup, -1);
+    bool stopped = false;
+    do {
+        rc = sqlite3_backup_step(backup, BACKUP_PAGES_PER_STEP);
+        if (background) {
+            int total = sqlite3_backup_pagecount(backup);
+            report_progress(DB_BACKUP_COPYING, total - sqlite3_backup_remaining(backup), total, NULL, false);
+            stopped = rc != SQLITE_DONE && backup_pause(BACKUP_STEP_PAUSE_MS);
+        } else if (rc == SQLITE_BUSY || rc == SQLITE_LOCKED) {
+            usleep(BACKUP_STEP_PAUSE_MS * 1000);
+        }
+    } while (!stopped && (rc == SQLITE_OK || rc == SQLITE_BUSY || rc == SQLITE_LOCKED));
+
     if (rc != SQLITE_DONE) {
-        log_error("Failed to perform backup: %s", sqlite3_errmsg(dest_db));
+        if (!stopped) {
+            log_error("Failed to perform backup: %s", sqlite3_errstr(rc));
+        }
         sqlite3_backup_finish(backup);
+        if (snapshot) {
+            sqlite3_exec(source_db, "ROLLBACK", NULL, NULL, NULL);
+        }
         sqlite3_close(source_db);
         sqlite3_close(dest_db);
-        backup_in_progress = false;
-        return -1;
+        unlink(tmp_path);
+        return stopped ? 1 : -1;
     }
-    
+
     // Finish the backup
     rc = sqlite3_backup_finish(backup);
+    if (snapshot) {
+        sqlite3_exec(source_db, "COMMIT", NULL, NULL, NULL);
+    }
     if (rc != SQLITE_OK) {
         log_error("Failed to finish backup: %s", sqlite3_errmsg(dest_db));
         sqlite3_close(source_db);
         sqlite3_close(dest_db);
-        backup_in_progress = false;
+        unlink(tmp_path);
         return -1;
     }
-    
+
     // Close the databases
     sqlite3_close(source_db);
     sqlite3_close(dest_db);
-    
-    log_info("Database backup completed successfully");
-    backup_in_progress = false;
+
+    // Synchronous writes were off, so flush before the copy replaces the old one
+    int fd = open(tmp_path, O_RDONLY);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+    if (rename(tmp_path, dest_path) != 0) {
+        log_error("Failed to move backup into place: %s", strerror(errno));
+        unlink(tmp_path);
+        return -1;
+    }
     return 0;
 }
 
+// Backup the database to a specified path
+int backup_database(const char *source_path, const char *dest_path) {
+    if (!begin_backup()) {
+        log_warn("Backup already in progress, skipping");
+        return -1;
+    }
+
+    log_info("Starting database backup from %s to %s", source_path, dest_path);
+
+    int result = copy_database(source_path, dest_path, false);
+    if (result == 0) {
+        log_info("Database backup completed successfully");
+    }
+
+    end_backup();
+    return result == 0 ? 0 : -1;
+}
+
+#ifdef HAVE_ZLIB
+// Compress a file to gzip in chunks, pausing between them
+static int compress_backup(const char *path, const char *gz_path) {
+    char tmp_path[1100];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", gz_path);
+
+    FILE *src = fopen(path, "rb");
+    if (!src) {
+        log_error("Failed to open backup for compression: %s", strerror(errno));
+        return -1;
+    }
+    struct stat st;
+    long long total = fstat(fileno(src), &st) == 0 ? (long long)st.st_size : 0;
+
+    gzFile dst = gzopen(tmp_path, "wb6");
+    if (!dst) {
+        log_error("Failed to create compressed backup %s", tmp_path);
+        fclose(src);
+        return -1;
+    }
+
+    char *buffer = malloc(BACKUP_COMPRESS_CHUNK);
+    if (!buffer) {
+        fclose(src);
+        gzclose(dst);
+        unlink(tmp_path);
+        return -1;
+    }
+
+    // Progress is reported in pages of the copy, so the bar keeps its scale
+    int pages_total = backup_status.pages_total;
+    long long done = 0;
+    int result = 0;
+    size_t bytes;
+    while ((bytes = fread(buffer, 1, BACKUP_COMPRESS_CHUNK, src)) > 0) {
+        if (gzwrite(dst, buffer, (unsigned int)bytes) != (int)bytes) {
+            log_error("Failed to write compressed backup");
+            result = -1;
+            break;
+        }
+        done += (long long)bytes;
+        int pages_done = total > 0 ? (int)(done * pages_total / total) : pages_total;
+        report_progress(DB_BACKUP_COMPRESSING, pages_done, pages_total, NULL, false);
+        if (backup_pause(BACKUP_STEP_PAUSE_MS)) {
+            result = 1;
+            break;
+        }
+    }
+    if (result == 0 && ferror(src)) {
+        log_error("Failed to read backup for compression: %s", strerror(errno));
+        result = -1;
+    }
+
+    free(buffer);
+    fclose(src);
+    if (gzclose(dst) != Z_OK && result == 0) {
+        log_error("Failed to finish compressed backup");
+        result = -1;
+    }
+
+    if (result == 0 && rename(tmp_path, gz_path) != 0) {
+        log_error("Failed to move compressed backup into place: %s", strerror(errno));
+        result = -1;
+    }
+    if (result != 0) {
+        unlink(tmp_path);
+    }
+    return result;
+}
+#endif
+
+static void *backup_thread_func(void *arg) {
+    (void)arg;
+    pthread_setname_np(pthread_self(), "db-backup");
+
+    char dest_path[sizeof(backup_status.path)];
+    pthread_mutex_lock(&backup_mutex);
+    snprintf(dest_path, sizeof(dest_path), "%s", backup_status.path);
+    pthread_mutex_unlock(&backup_mutex);
+
+    log_info("Starting background database backup from %s to %s", backup_source, dest_path);
+    report_progress(DB_BACKUP_COPYING, 0, 0, NULL, true);
+
+    int result = copy_database(backup_source, dest_path, true);
+
+#ifdef HAVE_ZLIB
+    if (result == 0 && backup_compress) {
+        char gz_path[sizeof(backup_status.path)];
+        if (snprintf(gz_path, sizeof(gz_path), "%s.gz", dest_path) >= (int)sizeof(gz_path)) {
+            log_error("Compressed backup path too long");
+            result = -1;
+        } else {
+            report_progress(DB_BACKUP_COMPRESSING, 0, backup_status.pages_total, NULL, true);
+            result = compress_backup(dest_path, gz_path);
+            if (result == 0) {
+                unlink(dest_path);
+                pthread_mutex_lock(&backup_mutex);
+                snprintf(backup_status.path, sizeof(backup_status.path), "%s", gz_path);
+                pthread_mutex_unlock(&backup_mutex);
+            }
+        }
+    }
+#endif
+
+    struct stat st;
+    pthread_mutex_lock(&backup_mutex);
+    if (result == 0 && stat(backup_status.path, &st) == 0) {
+        backup_status.size = (long long)st.st_size;
+    }
+    int pages_total = backup_status.pages_total;
+    pthread_mutex_unlock(&backup_mutex);
+
+    if (result == 0) {
+        log_info("Background database backup completed successfully");
+        report_progress(DB_BACKUP_DONE, pages_total, pages_total, NULL, true);
+    } else if (result > 0) {
+        log_info("Background database backup stopped");
+        report_progress(DB_BACKUP_ABORTED, backup_status.pages_done, pages_total, "stopped by shutdown", true);
+    } else {
+        report_progress(DB_BACKUP_FAILED, backup_status.pages_done, pages_total, "backup failed, see the log", true);
+    }
+
+    end_backup();
+    return NULL;
+}
+
+int start_database_backup(const char *source_path, const char *dest_path, bool compress) {
+    if (!source_path || !dest_path) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&backup_mutex);
+    if (backup_thread_started && !backup_in_progress) {
+        // Reap the previous backup, which has finished
+        pthread_mutex_unlock(&backup_mutex);
+        pthread_join(backup_thread, NULL);
+        pthread_mutex_lock(&backup_mutex);
+        backup_thread_started = false;
+    }
+    if (backup_in_progress) {
+        pthread_mutex_unlock(&backup_mutex);
+        log_warn("Backup already in progress, not starting another");
+        return 1;
+    }
+
+#ifndef HAVE_ZLIB
+    if (compress) {
+        log_warn("Built without zlib, database backup is not compressed");
+        compress = false;
+    }
+#endif
+
+    snprintf(backup_source, sizeof(backup_source), "%s", source_path);
+    backup_compress = compress;
+    backup_stopping = false;
+    memset(&backup_status, 0, sizeof(backup_status));
+    backup_status.state = DB_BACKUP_COPYING;
+    backup_status.started_at = time(NULL);
+    backup_status.compressed = compress;
+    snprintf(backup_status.path, sizeof(backup_status.path), "%s", dest_path);
+    backup_in_progress = true;
+
+    if (pthread_create(&backup_thread, NULL, backup_thread_func, NULL) != 0) {
+        log_error("Failed to start background database backup");
+        backup_status.state = DB_BACKUP_FAILED;
+        backup_in_progress = false;
+        pthread_mutex_unlock(&backup_mutex);
+        return -1;
+    }
+    backup_thread_started = true;
+    pthread_mutex_unlock(&backup_mutex);
+    return 0;
+}
+
+void stop_database_backup(void) {
+    pthread_mutex_lock(&backup_mutex);
+    if (!backup_thread_started) {
+        pthread_mutex_unlock(&backup_mutex);
+        return;
+    }
+    backup_stopping = true;
+    pthread_cond_signal(&backup_cond);
+    pthread_mutex_unlock(&backup_mutex);
+
+    pthread_join(backup_thread, NULL);
+
+    pthread_mutex_lock(&backup_mutex);
+    backup_thread_started = false;
+    pthread_mutex_unlock(&backup_mutex);
+}
+
+void get_backup_status(db_backup_status_t *status) {
+    pthread_mutex_lock(&backup_mutex);
+    *status = backup_status;
+    pthread_mutex_unlock(&backup_mutex);
+}
+
+void set_backup_progress_callback(db_backup_progress_fn fn) {
+    pthread_mutex_lock(&backup_mutex);
+    progress_fn = fn;
+    pthread_mutex_unlock(&backup_mutex);
+}
+
 // Restore database from backup
 int restore_database_from_backup(const char *backup_path, const char *db_path) {
     int rc;
@@ -0,0 +1,170 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+#include <sqlite3.h>
+
+#include "database/db_compaction.h"
+#include "database/db_core.h"
+#include "database/db_recording_usage.h"
+#include "core/logger.h"
+
+// Usage change of one compacted recording, applied once committed
+typedef struct {
+    char stream_name[64];
+    int64_t size_delta;
+    time_t start_time;
+    time_t end_time;
+} compaction_usage_t;
+
+/**
+ * Point one recording at its container
+ *
+ * @return SQLITE_OK on success, SQLITE_NOTFOUND if it changed meanwhile, or an error
+ */
+static int compact_one(sqlite3 *db, const char *container, const compacted_recording_t *r,
+                       compaction_usage_t *usage) {
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, "SELECT stream_name, size_bytes, start_time, end_time FROM recordings "
+                               "WHERE id = ? AND file_path = ?;", -1, &stmt, NULL) != SQLITE_OK) {
+        return SQLITE_ERROR;
+    }
+    sqlite3_bind_int64(stmt, 1, (sqlite3_int64)r->recording_id);
+    sqlite3_bind_text(stmt, 2, r->source_path, -1, SQLITE_STATIC);
+    int rc = sqlite3_step(stmt);
+    if (rc == SQLITE_ROW) {
+        const char *stream = (const char *)sqlite3_column_text(stmt, 0);
+        strncpy(usage->stream_name, stream ? stream : "", sizeof(usage->stream_name) - 1);
+        usage->stream_name[sizeof(usage->stream_name) - 1] = '\0';
+        usage->size_delta = (int64_t)r->size_bytes - sqlite3_column_int64(stmt, 1);
+        usage->start_time = (time_t)sqlite3_column_int64(stmt, 2);
+        usage->end_time = (time_t)sqlite3_column_int64(stmt, 3);
+        rc = SQLITE_OK;
+    } else {
+        rc = rc == SQLITE_DONE ? SQLITE_NOTFOUND : SQLITE_ERROR;
+    }
+    sqlite3_finalize(stmt);
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+
+    if (sqlite3_prepare_v2(db, "UPDATE recordings SET file_path = ?, size_bytes = ? WHERE id = ?;",
+                           -1, &stmt, NULL) != SQLITE_OK) {
+        return SQLITE_ERROR;
+    }
+    sqlite3_bind_text(stmt, 1, container, -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 2, (sqlite3_int64)r->size_bytes);
+    sqlite3_bind_int64(stmt, 3, (sqlite3_int64)r->recording_id);
+    rc = sqlite3_step(stmt) == SQLITE_DONE ? SQLITE_OK : SQLITE_ERROR;
+    sqlite3_finalize(stmt);
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+
+    if (sqlite3_prepare_v2(db, "INSERT OR REPLACE INTO compacted_recordings "
+                               "(recording_id, container, offset_ms, duration_ms, source_path) "
+                               "VALUES (?, ?, ?, ?, ?);", -1, &stmt, NULL) != SQLITE_OK) {
+        return SQLITE_ERROR;
+    }
+    sqlite3_bind_int64(stmt, 1, (sqlite3_int64)r->recording_id);
+    sqlite3_bind_text(stmt, 2, container, -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 3, r->offset_ms);
+    sqlite3_bind_int64(stmt, 4, r->duration_ms);
+    sqlite3_bind_text(stmt, 5, r->source_path, -1, SQLITE_STATIC);
+    rc = sqlite3_step(stmt) == SQLITE_DONE ? SQLITE_OK : SQLITE_ERROR;
+    sqlite3_finalize(stmt);
+    return rc;
+}
+
+// Point recordings at the container they were copied into
+int compact_recordings(const char *container, const compacted_recording_t *recordings, int count) {
+    if (!container || !recordings || count <= 0) {
+        return -1;
+    }
+
+    sqlite3 *db = get_db_handle();
+    pthread_mutex_t *db_mutex = get_db_mutex();
+    if (!db) {
+        log_error("Database not initialized");
+        return -1;
+    }
+
+    compaction_usage_t *usage = calloc((size_t)count, sizeof(compaction_usage_t));
+    if (!usage) {
+        return -1;
+    }
+
+    lock_db_mutex();
+
+    char *err_msg = NULL;
+    if (sqlite3_exec(db, "BEGIN TRANSACTION;", NULL, NULL, &err_msg) != SQLITE_OK) {
+        log_error("Failed to begin transaction: %s", err_msg);
+        sqlite3_free(err_msg);
+        pthread_mutex_unlock(db_mutex);
+        free(usage);
+        return -1;
+    }
+
+    int rc = SQLITE_OK;
+    for (int i = 0; i < count && rc == SQLITE_OK; i++) {
+        rc = compact_one(db, container, &recordings[i], &usage[i]);
+    }
+
+    if (rc != SQLITE_OK || sqlite3_exec(db, "COMMIT;", NULL, NULL, &err_msg) != SQLITE_OK) {
+        if (rc != SQLITE_NOTFOUND) {
+            log_error("Failed to compact %d recordings into %s: %s", count, container,
+                      err_msg ? err_msg : sqlite3_errmsg(db));
+        }
+        sqlite3_free(err_msg);
+        sqlite3_exec(db, "ROLLBACK;", NULL, NULL, NULL);
+        pthread_mutex_unlock(db_mutex);
+        free(usage);
+        return rc == SQLITE_NOTFOUND ? 1 : -1;
+    }
+
+    for (int i = 0; i < count; i++) {
+        recording_usage_resize(usage[i].stream_name, usage[i].size_delta, usage[i].start_time,
+                               usage[i].end_time);
+    }
+    pthread_mutex_unlock(db_mutex);
+    free(usage);
+    return 0;
+}
+
+// Get the place of a recording in its container
+int get_recording_compaction(uint64_t recording_id, compacted_recording_t *compacted) {
+    sqlite3_stmt *stmt;
+
+    sqlite3 *db = acquire_db_reader();
+    if (!db) {
+        log_error("Database not initialized");
+        return -1;
+    }
+
+    if (sqlite3_prepare_v2(db, "SELECT offset_ms, duration_ms, source_path FROM compacted_recordings "
+                               "WHERE recording_id = ?;", -1, &stmt, NULL) != SQLITE_OK) {
+        log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+        release_db_reader(db);
+        return -1;
+    }
+    sqlite3_bind_int64(stmt, 1, (sqlite3_int64)recording_id);
+
+    int result = 0;
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        if (compacted) {
+            const char *source = (const char *)sqlite3_column_text(stmt, 2);
+            memset(compacted, 0, sizeof(*compacted));
+            compacted->recording_id = recording_id;
+            compacted->offset_ms = sqlite3_column_int64(stmt, 0);
+            compacted->duration_ms = sqlite3_column_int64(stmt, 1);
+            strncpy(compacted->source_path, source ? source : "", sizeof(compacted->source_path) - 1);
+        }
+        result = 1;
+    }
+
+    sqlite3_finalize(stmt);
+    release_db_reader(db);
+    return result;
+}
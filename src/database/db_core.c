@@ -21,7 +21,12 @@
 #include "database/db_core.h"
 #include "database/db_schema.h"
 #include "database/db_backup.h"
+#include "database/db_detections.h"
+#include "database/db_integrity.h"
+#include "database/db_recordings.h"
+#include "core/config.h"
 #include "core/logger.h"
+#include "core/metrics.h"
 
 // Database handle
 static sqlite3 *db = NULL;
@@ -47,7 +52,87 @@ static bool wal_mode_enabled = false;
 // Flag to indicate if a backup is in progress
 static bool backup_in_progress = false;
 
-// No longer tracking prepared statements - each function is responsible for finalizing its own statements
+// Prepared statements of the hot queries
+typedef struct {
+    sqlite3_stmt *stmt;
+    char *sql;              // Copy of the text the statement was prepared from
+    db_stmt_id_t id;
+    uint64_t started_us;    // When the current use began, for the query latency metric
+} cached_stmt_t;
+
+// Query names for the latency metric, indexed by db_stmt_id_t
+static const char *const stmt_names[DB_STMT_COUNT] = {
+    [DB_STMT_RECORDING_INSERT] = "recording_insert",
+    [DB_STMT_RECORDING_UPDATE] = "recording_update",
+    [DB_STMT_RECORDING_BY_ID] = "recording_by_id",
+    [DB_STMT_RECORDING_DELETE] = "recording_delete",
+    [DB_STMT_RECORDING_SIZE] = "recording_size",
+    [DB_STMT_RECORDING_SEGMENT_INSERT] = "recording_segment_insert",
+    [DB_STMT_STREAM_BY_NAME] = "stream_by_name",
+    [DB_STMT_STREAM_ELIGIBLE] = "stream_eligible",
+    [DB_STMT_STREAM_ENABLED_COUNT] = "stream_enabled_count",
+    [DB_STMT_STREAM_COUNT] = "stream_count",
+    [DB_STMT_DETECTION_INSERT] = "detection_insert",
+    [DB_STMT_DETECTION_RANGE] = "detection_range",
+    [DB_STMT_DETECTION_ACTIVITY_ADD] = "detection_activity_add",
+    [DB_STMT_STREAM_ID_ADD] = "stream_id_add",
+    [DB_STMT_DETECTION_SEARCH] = "detection_search",
+    [DB_STMT_DETECTION_RECORDING] = "detection_recording",
+    [DB_STMT_USER_BY_ID] = "user_by_id",
+    [DB_STMT_USER_BY_USERNAME] = "user_by_username",
+    [DB_STMT_USER_BY_API_KEY] = "user_by_api_key",
+    [DB_STMT_SESSION_VALIDATE] = "session_validate",
+};
+
+// Query latency histograms, registered on first use
+static metric_t stmt_metrics[DB_STMT_COUNT];
+
+// Statements of the writer connection, guarded by db_mutex
+static cached_stmt_t stmt_cache[DB_STMT_COUNT];
+static db_stmt_cache_stats_t stmt_cache_stats;
+
+// Other statements are finalized by the function that prepared them
+
+// Read-only connections for queries that can run beside the writer in WAL mode
+#define DB_READER_POOL_SIZE 4
+
+typedef struct {
+    sqlite3 *db;
+    bool in_use;
+    cached_stmt_t cache[DB_STMT_COUNT];     // Owned by the thread using the reader
+} db_reader_t;
+
+static db_reader_t readers[DB_READER_POOL_SIZE];
+static int reader_count = 0;
+static bool readers_closing = false;
+static pthread_mutex_t reader_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t reader_cond = PTHREAD_COND_INITIALIZER;
+
+// WAL pages after which the checkpoint thread is woken up early
+#define WAL_CHECKPOINT_PAGES 1000
+// Seconds between checkpoints when the WAL grows slowly
+#define WAL_CHECKPOINT_INTERVAL 30
+
+// Seconds after startup before the full integrity check begins, so it does
+// not compete with streams starting to record
+#define INTEGRITY_CHECK_DELAY 120
+
+// Committed changes per table group, see get_table_version()
+static uint64_t table_versions[DB_TABLE_COUNT];
+// Groups changed by the transaction in progress on the writer connection
+static unsigned int pending_tables = 0;
+
+// Background checkpointing on its own connection, so it never takes db_mutex
+static sqlite3 *checkpoint_db = NULL;
+static pthread_t checkpoint_thread;
+static bool checkpoint_running = false;
+static int wal_pages = 0;
+static pthread_mutex_t checkpoint_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t checkpoint_cond = PTHREAD_COND_INITIALIZER;
+
+// Sizes of the connections, from the device profile
+static int db_cache_kb = 0;
+static int db_mmap_mb = 0;
 
 // Create directory if it doesn't exist
 static int create_directory(const char *path) {
@@ -93,8 +178,6 @@ static int create_directory(const char *path) {
 
 // Function to checkpoint the database WAL file
 int checkpoint_database(void) {
-    int rc = SQLITE_OK;
-
     if (!db) {
         log_error("Database not initialized");
         return -1;
@@ -105,28 +188,657 @@ int checkpoint_database(void) {
         return 0;
     }
 
-    pthread_mutex_lock(&db_mutex);
+    // The checkpoint connection waits for readers without holding up the writer
+    sqlite3 *conn = checkpoint_db;
+    if (!conn) {
+        lock_db_mutex();
+        conn = db;
+    }
 
     log_info("Checkpointing WAL file");
-    rc = sqlite3_exec(db, "PRAGMA wal_checkpoint(FULL);", NULL, NULL, NULL);
+    int rc = sqlite3_wal_checkpoint_v2(conn, NULL, SQLITE_CHECKPOINT_FULL, NULL, NULL);
     if (rc != SQLITE_OK) {
-        log_error("Failed to checkpoint WAL: %s", sqlite3_errmsg(db));
+        log_error("Failed to checkpoint WAL: %s", sqlite3_errmsg(conn));
+    } else {
+        log_info("WAL checkpoint successful");
+    }
+
+    if (conn == db) {
         pthread_mutex_unlock(&db_mutex);
-        return -1;
     }
+    return rc == SQLITE_OK ? 0 : -1;
+}
+
+// Table group of a table; partitions and helper tables share a prefix
+static db_table_t table_group(const char *table) {
+    static const struct {
+        const char *prefix;
+        db_table_t group;
+    } groups[] = {
+        {"stream", DB_TABLE_STREAMS},
+        {"recording", DB_TABLE_RECORDINGS},
+        {"detection", DB_TABLE_DETECTIONS},
+        {"event", DB_TABLE_EVENTS},
+        {"users", DB_TABLE_USERS},
+    };
+
+    for (size_t i = 0; i < sizeof(groups) / sizeof(groups[0]); i++) {
+        if (strncmp(table, groups[i].prefix, strlen(groups[i].prefix)) == 0) {
+            return groups[i].group;
+        }
+    }
+    return DB_TABLE_OTHER;
+}
+
+// Called by SQLite on the writer connection for each changed row
+static void table_update_hook(void *arg, int op, const char *db_name, const char *table, sqlite3_int64 rowid) {
+    (void)arg;
+    (void)op;
+    (void)db_name;
+    (void)rowid;
+    pending_tables |= 1u << table_group(table);
+}
+
+// Count the changes of the transaction that just committed
+static void publish_table_versions(void) {
+    unsigned int pending = pending_tables;
+    pending_tables = 0;
+    for (int i = 0; i < DB_TABLE_COUNT; i++) {
+        if (pending & (1u << i)) {
+            __atomic_fetch_add(&table_versions[i], 1, __ATOMIC_RELEASE);
+        }
+    }
+}
 
-    log_info("WAL checkpoint successful");
-    pthread_mutex_unlock(&db_mutex);
+// Without WAL readers share the writer connection and its mutex, so the
+// changes cannot be read before the commit completes
+static int table_commit_hook(void *arg) {
+    (void)arg;
+    if (!wal_mode_enabled) {
+        publish_table_versions();
+    }
     return 0;
 }
 
+static void table_rollback_hook(void *arg) {
+    (void)arg;
+    pending_tables = 0;
+}
+
+uint64_t get_table_version(db_table_t table) {
+    if (table < 0 || table >= DB_TABLE_COUNT) {
+        return 0;
+    }
+    return __atomic_load_n(&table_versions[table], __ATOMIC_ACQUIRE);
+}
+
+// Called by SQLite on the writer connection after each commit
+static int wal_commit_hook(void *arg, sqlite3 *conn, const char *db_name, int pages) {
+    (void)arg;
+
+    // The commit is visible to the readers by now
+    publish_table_versions();
+
+    pthread_mutex_lock(&checkpoint_mutex);
+    bool running = checkpoint_running;
+    wal_pages = pages;
+    if (running && pages >= WAL_CHECKPOINT_PAGES) {
+        pthread_cond_signal(&checkpoint_cond);
+    }
+    pthread_mutex_unlock(&checkpoint_mutex);
+
+    // Without the checkpoint thread, checkpoint on commit as SQLite would
+    if (!running && pages >= WAL_CHECKPOINT_PAGES) {
+        sqlite3_wal_checkpoint(conn, db_name);
+    }
+    return SQLITE_OK;
+}
+
+// Copy committed WAL pages into the database without blocking readers or the writer
+static void *checkpoint_thread_func(void *arg) {
+    (void)arg;
+    pthread_setname_np(pthread_self(), "db-checkpoint");
+
+    pthread_mutex_lock(&checkpoint_mutex);
+    while (checkpoint_running) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += WAL_CHECKPOINT_INTERVAL;
+        while (checkpoint_running && wal_pages < WAL_CHECKPOINT_PAGES) {
+            if (pthread_cond_timedwait(&checkpoint_cond, &checkpoint_mutex, &deadline) == ETIMEDOUT) {
+                break;
+            }
+        }
+        if (!checkpoint_running) {
+            break;
+        }
+        int pages = wal_pages;
+        wal_pages = 0;
+        pthread_mutex_unlock(&checkpoint_mutex);
+
+        if (pages > 0) {
+            int log_frames = 0, checkpointed = 0;
+            int rc = sqlite3_wal_checkpoint_v2(checkpoint_db, NULL, SQLITE_CHECKPOINT_PASSIVE,
+                                               &log_frames, &checkpointed);
+            if (rc != SQLITE_OK && rc != SQLITE_BUSY) {
+                log_warn("Background WAL checkpoint failed: %s", sqlite3_errmsg(checkpoint_db));
+            } else {
+                log_debug("Background WAL checkpoint: %d of %d frames", checkpointed, log_frames);
+            }
+        }
+
+        pthread_mutex_lock(&checkpoint_mutex);
+    }
+    pthread_mutex_unlock(&checkpoint_mutex);
+    return NULL;
+}
+
+// Open the checkpoint connection and hand WAL checkpoints over to its thread
+static void start_checkpoint_thread(const char *db_path) {
+    if (sqlite3_open_v2(db_path, &checkpoint_db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_FULLMUTEX | SQLITE_OPEN_PRIVATECACHE,
+                        NULL) != SQLITE_OK) {
+        log_warn("Failed to open checkpoint connection, SQLite checkpoints on commit");
+        sqlite3_close_v2(checkpoint_db);
+        checkpoint_db = NULL;
+        return;
+    }
+    sqlite3_busy_timeout(checkpoint_db, 5000);
+    // A connection only checkpoints once it has opened the WAL itself
+    sqlite3_exec(checkpoint_db, "PRAGMA journal_mode=WAL;", NULL, NULL, NULL);
+
+    checkpoint_running = true;
+    if (pthread_create(&checkpoint_thread, NULL, checkpoint_thread_func, NULL) != 0) {
+        log_warn("Failed to start checkpoint thread, SQLite checkpoints on commit");
+        checkpoint_running = false;
+        sqlite3_close_v2(checkpoint_db);
+        checkpoint_db = NULL;
+        return;
+    }
+
+    // Shrink the WAL file when the writer restarts it after a checkpoint
+    sqlite3_exec(db, "PRAGMA journal_size_limit=16777216;", NULL, NULL, NULL);
+    log_info("Background WAL checkpointing started");
+}
+
+static void stop_checkpoint_thread(void) {
+    pthread_mutex_lock(&checkpoint_mutex);
+    if (!checkpoint_running) {
+        pthread_mutex_unlock(&checkpoint_mutex);
+        return;
+    }
+    checkpoint_running = false;
+    pthread_cond_signal(&checkpoint_cond);
+    pthread_mutex_unlock(&checkpoint_mutex);
+    pthread_join(checkpoint_thread, NULL);
+
+    // The WAL hook checkpoints on commit from now on
+    sqlite3_close_v2(checkpoint_db);
+    checkpoint_db = NULL;
+}
+
+// Prepare a statement into a cache slot, or reuse the one there
+static sqlite3_stmt *cache_lookup(sqlite3 *conn, cached_stmt_t *entry, db_stmt_id_t id, const char *sql) {
+    entry->id = id;
+    entry->started_us = metrics_now_us();
+
+    if (entry->stmt) {
+        if (strcmp(entry->sql, sql) == 0) {
+            __atomic_fetch_add(&stmt_cache_stats.hits, 1, __ATOMIC_RELAXED);
+            sqlite3_reset(entry->stmt);
+            sqlite3_clear_bindings(entry->stmt);
+            return entry->stmt;
+        }
+        sqlite3_finalize(entry->stmt);
+        entry->stmt = NULL;
+        free(entry->sql);
+        entry->sql = NULL;
+        __atomic_fetch_sub(&stmt_cache_stats.cached, 1, __ATOMIC_RELAXED);
+    }
+
+    // Callers may build the text in a buffer, e.g. with a partition name
+    entry->sql = strdup(sql);
+    if (!entry->sql) {
+        return NULL;
+    }
+    if (sqlite3_prepare_v3(conn, sql, -1, SQLITE_PREPARE_PERSISTENT, &entry->stmt, NULL) != SQLITE_OK) {
+        log_error("Failed to prepare statement: %s", sqlite3_errmsg(conn));
+        entry->stmt = NULL;
+        free(entry->sql);
+        entry->sql = NULL;
+        return NULL;
+    }
+    __atomic_fetch_add(&stmt_cache_stats.prepares, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stmt_cache_stats.cached, 1, __ATOMIC_RELAXED);
+    return entry->stmt;
+}
+
+static void cache_clear(cached_stmt_t *cache) {
+    for (int i = 0; i < DB_STMT_COUNT; i++) {
+        if (cache[i].stmt) {
+            sqlite3_finalize(cache[i].stmt);
+            cache[i].stmt = NULL;
+            free(cache[i].sql);
+            cache[i].sql = NULL;
+        }
+    }
+}
+
+// Get the cached statement for a query
+sqlite3_stmt *get_cached_stmt(db_stmt_id_t id, const char *sql) {
+    if (!db || id < 0 || id >= DB_STMT_COUNT || !sql) {
+        return NULL;
+    }
+    return cache_lookup(db, &stmt_cache[id], id, sql);
+}
+
+// Get the cached statement for a query on a connection from acquire_db_reader()
+sqlite3_stmt *get_reader_cached_stmt(sqlite3 *reader, db_stmt_id_t id, const char *sql) {
+    if (!reader || id < 0 || id >= DB_STMT_COUNT || !sql) {
+        return NULL;
+    }
+    if (reader == db) {
+        return cache_lookup(db, &stmt_cache[id], id, sql);
+    }
+    for (int i = 0; i < reader_count; i++) {
+        if (readers[i].db == reader) {
+            return cache_lookup(reader, &readers[i].cache[id], id, sql);
+        }
+    }
+    return NULL;
+}
+
+// Find the cache entry of a statement; only the caller's own caches are searched
+static cached_stmt_t *find_cache_entry(sqlite3_stmt *stmt) {
+    sqlite3 *conn = sqlite3_db_handle(stmt);
+    cached_stmt_t *cache = NULL;
+
+    if (conn == db) {
+        cache = stmt_cache;
+    } else {
+        for (int i = 0; i < reader_count; i++) {
+            if (readers[i].db == conn) {
+                cache = readers[i].cache;
+                break;
+            }
+        }
+    }
+    if (!cache) {
+        return NULL;
+    }
+
+    for (int i = 0; i < DB_STMT_COUNT; i++) {
+        if (cache[i].stmt == stmt) {
+            return &cache[i];
+        }
+    }
+    return NULL;
+}
+
+// Record how long a query held its statement
+static void observe_query(cached_stmt_t *entry) {
+    if (entry->started_us == 0) {
+        return;
+    }
+
+    metric_t metric = __atomic_load_n(&stmt_metrics[entry->id], __ATOMIC_RELAXED);
+    if (!metric) {
+        // Registering twice returns the same series, so a race here is harmless
+        metric = metrics_histogram("lightnvr_db_query_seconds",
+                                   "Time from preparing a cached query to releasing it",
+                                   "query", stmt_names[entry->id], NULL);
+        __atomic_store_n(&stmt_metrics[entry->id], metric, __ATOMIC_RELAXED);
+    }
+    metrics_observe_since(metric, entry->started_us);
+    entry->started_us = 0;
+}
+
+// Hand back a cached statement
+void release_cached_stmt(sqlite3_stmt *stmt) {
+    if (stmt) {
+        sqlite3_reset(stmt);
+        sqlite3_clear_bindings(stmt);
+
+        cached_stmt_t *entry = find_cache_entry(stmt);
+        if (entry) {
+            observe_query(entry);
+        }
+    }
+}
+
+// Slow statements whose plan was logged, by hash of their text
+#define EXPLAINED_MAX 256
+
+static uint64_t explained[EXPLAINED_MAX];
+static int explained_count = 0;
+static pthread_mutex_t explain_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Connection for EXPLAIN QUERY PLAN, guarded by explain_mutex; the trace
+// callback must not prepare statements on the connection it reports on
+static sqlite3 *explain_db = NULL;
+
+// Execution time and full scan histograms by query name, the last slot for
+// statements outside the cache; registered on first use
+static metric_t exec_metrics[DB_STMT_COUNT + 1];
+static metric_t scan_metrics[DB_STMT_COUNT + 1];
+
+// Lock waits of the writer mutex and the reader pool
+static metric_t writer_wait_metric;
+static metric_t reader_wait_metric;
+
+static metric_t lock_wait_metric(metric_t *slot, const char *lock) {
+    metric_t metric = __atomic_load_n(slot, __ATOMIC_RELAXED);
+    if (!metric) {
+        metric = metrics_histogram("lightnvr_db_lock_wait_seconds",
+                                   "Time spent waiting for a database connection",
+                                   "lock", lock, NULL);
+        __atomic_store_n(slot, metric, __ATOMIC_RELAXED);
+    }
+    return metric;
+}
+
+static uint64_t hash_sql(const char *sql) {
+    uint64_t h = 1469598103934665603ULL;
+    for (const unsigned char *p = (const unsigned char *)sql; *p; p++) {
+        h = (h ^ *p) * 1099511628211ULL;
+    }
+    return h;
+}
+
+/**
+ * Log the query plan of a slow statement the first time it is seen
+ * Runs on its own read-only connection without waiting for locks, so a plan
+ * that can't be had right now is tried again the next time the statement is slow.
+ */
+static void explain_slow_query(const char *sql, const char *query, uint64_t ms) {
+    uint64_t h = hash_sql(sql);
+
+    pthread_mutex_lock(&explain_mutex);
+    for (int i = 0; i < explained_count; i++) {
+        if (explained[i] == h) {
+            pthread_mutex_unlock(&explain_mutex);
+            return;
+        }
+    }
+    if (explained_count >= EXPLAINED_MAX || db_file_path[0] == '\0') {
+        pthread_mutex_unlock(&explain_mutex);
+        return;
+    }
+
+    if (!explain_db) {
+        if (sqlite3_open_v2(db_file_path, &explain_db, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX |
+                            SQLITE_OPEN_PRIVATECACHE, NULL) != SQLITE_OK) {
+            log_warn("Failed to open database for query plans: %s",
+                     explain_db ? sqlite3_errmsg(explain_db) : "unknown error");
+            sqlite3_close_v2(explain_db);
+            explain_db = NULL;
+            pthread_mutex_unlock(&explain_mutex);
+            return;
+        }
+    }
+
+    char *explain_sql = sqlite3_mprintf("EXPLAIN QUERY PLAN %s", sql);
+    sqlite3_stmt *stmt = NULL;
+    if (!explain_sql || sqlite3_prepare_v2(explain_db, explain_sql, -1, &stmt, NULL) != SQLITE_OK) {
+        log_debug("No query plan for slow query: %s", sqlite3_errmsg(explain_db));
+        sqlite3_free(explain_sql);
+        pthread_mutex_unlock(&explain_mutex);
+        return;
+    }
+    sqlite3_free(explain_sql);
+
+    // Rows are (id, parent, notused, detail); indent by depth in the plan tree
+    int ids[16];
+    int depth_count = 0;
+    int rc;
+    bool header = false;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        int id = sqlite3_column_int(stmt, 0);
+        int parent = sqlite3_column_int(stmt, 1);
+        const char *detail = (const char *)sqlite3_column_text(stmt, 3);
+
+        // Statements without a plan (DDL, PRAGMA, COMMIT) return no rows and log nothing
+        if (!header) {
+            log_warn("Query plan of slow query (%s, %llu ms): %s", query, (unsigned long long)ms, sql);
+            header = true;
+        }
+        while (depth_count > 0 && ids[depth_count - 1] != parent) {
+            depth_count--;
+        }
+        log_warn("  %*s%s", depth_count * 2, "", detail ? detail : "");
+        if (depth_count < (int)(sizeof(ids) / sizeof(ids[0]))) {
+            ids[depth_count++] = id;
+        }
+    }
+    sqlite3_finalize(stmt);
+
+    if (rc == SQLITE_DONE) {
+        explained[explained_count++] = h;
+    }
+    pthread_mutex_unlock(&explain_mutex);
+}
+
+/**
+ * SQLITE_TRACE_PROFILE callback, called when a statement finishes running
+ * Records the execution time and full scan rows of the statement by query
+ * name and logs statements slower than db_slow_query_ms.
+ */
+static int trace_profile(unsigned int type, void *ctx, void *p, void *x) {
+    (void)ctx;
+    if (type != SQLITE_TRACE_PROFILE) {
+        return 0;
+    }
+
+    sqlite3_stmt *stmt = p;
+    uint64_t ns = (uint64_t)*(sqlite3_int64 *)x;
+
+    // Counters accumulate over runs of a cached statement, so they are reset here
+    int fullscan = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_FULLSCAN_STEP, 1);
+    int sorts = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_SORT, 1);
+    int autoindex = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_AUTOINDEX, 1);
+    int vm_steps = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_VM_STEP, 1);
+
+    cached_stmt_t *entry = find_cache_entry(stmt);
+    int slot = entry ? (int)entry->id : DB_STMT_COUNT;
+    const char *query = entry ? stmt_names[entry->id] : "other";
+
+    metric_t exec_metric = __atomic_load_n(&exec_metrics[slot], __ATOMIC_RELAXED);
+    metric_t scan_metric = __atomic_load_n(&scan_metrics[slot], __ATOMIC_RELAXED);
+    if (!exec_metric || !scan_metric) {
+        exec_metric = metrics_histogram("lightnvr_db_statement_seconds",
+                                        "Time SQLite spent running a statement",
+                                        "query", query, NULL);
+        scan_metric = metrics_counter("lightnvr_db_fullscan_rows_total",
+                                      "Rows stepped through by full table scans",
+                                      "query", query, NULL);
+        __atomic_store_n(&exec_metrics[slot], exec_metric, __ATOMIC_RELAXED);
+        __atomic_store_n(&scan_metrics[slot], scan_metric, __ATOMIC_RELAXED);
+    }
+    metrics_observe_us(exec_metric, ns / 1000);
+    if (fullscan > 0) {
+        metrics_add(scan_metric, (uint64_t)fullscan);
+    }
+
+    int slow_ms = g_config.db_slow_query_ms;
+    if (slow_ms > 0 && ns >= (uint64_t)slow_ms * 1000000) {
+        // The text without bound values, which may be credentials
+        const char *sql = sqlite3_sql(stmt);
+        log_warn_ratelimited("Slow query (%s): %llu ms, %d full scan rows, %d sorts, %d automatic indexes, %d VM steps: %s",
+                 query, (unsigned long long)(ns / 1000000), fullscan, sorts, autoindex, vm_steps,
+                 sql ? sql : "");
+        if (sql) {
+            explain_slow_query(sql, query, ns / 1000000);
+        }
+    }
+    return 0;
+}
+
+// Report statement execution of a connection to trace_profile()
+static void trace_connection(sqlite3 *conn) {
+    if (sqlite3_trace_v2(conn, SQLITE_TRACE_PROFILE, trace_profile, NULL) != SQLITE_OK) {
+        log_warn("Failed to enable statement profiling: %s", sqlite3_errmsg(conn));
+    }
+}
+
+// Lock the writer mutex, recording the wait
+void lock_db_mutex(void) {
+    if (pthread_mutex_trylock(&db_mutex) == 0) {
+        metrics_observe_us(lock_wait_metric(&writer_wait_metric, "writer"), 0);
+        return;
+    }
+    uint64_t start = metrics_now_us();
+    pthread_mutex_lock(&db_mutex);
+    metrics_observe_since(lock_wait_metric(&writer_wait_metric, "writer"), start);
+}
+
+// Get the statement cache counters
+void get_stmt_cache_stats(db_stmt_cache_stats_t *stats) {
+    if (!stats) {
+        return;
+    }
+    stats->prepares = __atomic_load_n(&stmt_cache_stats.prepares, __ATOMIC_RELAXED);
+    stats->hits = __atomic_load_n(&stmt_cache_stats.hits, __ATOMIC_RELAXED);
+    stats->cached = __atomic_load_n(&stmt_cache_stats.cached, __ATOMIC_RELAXED);
+}
+
+size_t get_database_memory_usage(void) {
+    sqlite3_int64 used = sqlite3_memory_used();
+    return used > 0 ? (size_t)used : 0;
+}
+
+// Finalize the cached statements of the writer, must be called with db_mutex held
+static void clear_stmt_cache(void) {
+    cache_clear(stmt_cache);
+    log_info("Statement cache: %lu prepares, %lu reuses",
+             stmt_cache_stats.prepares, stmt_cache_stats.hits);
+    memset(&stmt_cache_stats, 0, sizeof(stmt_cache_stats));
+}
+
+void set_database_sizes(int cache_kb, int mmap_mb) {
+    db_cache_kb = cache_kb > 0 ? cache_kb : 0;
+    db_mmap_mb = mmap_mb > 0 ? mmap_mb : 0;
+}
+
+// Apply the page cache and memory map sizes to a connection
+static void apply_connection_sizes(sqlite3 *conn, int cache_kb) {
+    char sql[64];
+    if (cache_kb > 0) {
+        // Negative sizes are in KiB rather than pages
+        snprintf(sql, sizeof(sql), "PRAGMA cache_size=-%d;", cache_kb);
+        sqlite3_exec(conn, sql, NULL, NULL, NULL);
+    }
+    if (db_mmap_mb > 0) {
+        snprintf(sql, sizeof(sql), "PRAGMA mmap_size=%lld;", (long long)db_mmap_mb * 1024 * 1024);
+        sqlite3_exec(conn, sql, NULL, NULL, NULL);
+    }
+}
+
+// Open the read-only connections, only useful when WAL lets them run beside the writer
+static void open_db_readers(const char *db_path) {
+    pthread_mutex_lock(&reader_mutex);
+    readers_closing = false;
+    for (int i = 0; i < DB_READER_POOL_SIZE; i++) {
+        sqlite3 *conn = NULL;
+        if (sqlite3_open_v2(db_path, &conn, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX | SQLITE_OPEN_PRIVATECACHE,
+                            NULL) != SQLITE_OK) {
+            log_warn("Failed to open database reader %d: %s", i, conn ? sqlite3_errmsg(conn) : "unknown error");
+            sqlite3_close_v2(conn);
+            break;
+        }
+        sqlite3_busy_timeout(conn, 10000);
+        apply_connection_sizes(conn, db_cache_kb > 0 ? (db_cache_kb / 4 > 512 ? db_cache_kb / 4 : 512) : 0);
+        trace_connection(conn);
+        memset(&readers[reader_count], 0, sizeof(db_reader_t));
+        readers[reader_count].db = conn;
+        reader_count++;
+    }
+    pthread_mutex_unlock(&reader_mutex);
+    log_info("Opened %d read-only database connections", reader_count);
+}
+
+// Close the read-only connections once the queries on them have finished
+static void close_db_readers(void) {
+    pthread_mutex_lock(&reader_mutex);
+    readers_closing = true;
+    pthread_cond_broadcast(&reader_cond);
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += 10;
+    for (;;) {
+        bool busy = false;
+        for (int i = 0; i < reader_count; i++) {
+            busy = busy || readers[i].in_use;
+        }
+        if (!busy || pthread_cond_timedwait(&reader_cond, &reader_mutex, &deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+
+    for (int i = 0; i < reader_count; i++) {
+        if (readers[i].in_use) {
+            log_warn("Database reader %d still in use at shutdown", i);
+        }
+        cache_clear(readers[i].cache);
+        sqlite3_close_v2(readers[i].db);
+        readers[i].db = NULL;
+    }
+    reader_count = 0;
+    pthread_mutex_unlock(&reader_mutex);
+}
+
+// Get a connection for read-only queries
+sqlite3 *acquire_db_reader(void) {
+    uint64_t start = metrics_now_us();
+    pthread_mutex_lock(&reader_mutex);
+    while (reader_count > 0 && !readers_closing) {
+        for (int i = 0; i < reader_count; i++) {
+            if (!readers[i].in_use) {
+                readers[i].in_use = true;
+                pthread_mutex_unlock(&reader_mutex);
+                metrics_observe_since(lock_wait_metric(&reader_wait_metric, "reader"), start);
+                return readers[i].db;
+            }
+        }
+        pthread_cond_wait(&reader_cond, &reader_mutex);
+    }
+    pthread_mutex_unlock(&reader_mutex);
+
+    // No pool, fall back to the writer connection
+    lock_db_mutex();
+    if (!db) {
+        pthread_mutex_unlock(&db_mutex);
+        return NULL;
+    }
+    return db;
+}
+
+// Return a connection from acquire_db_reader()
+void release_db_reader(sqlite3 *reader) {
+    if (!reader) {
+        return;
+    }
+    if (reader == db) {
+        pthread_mutex_unlock(&db_mutex);
+        return;
+    }
+
+    pthread_mutex_lock(&reader_mutex);
+    for (int i = 0; i < reader_count; i++) {
+        if (readers[i].db == reader) {
+            readers[i].in_use = false;
+            break;
+        }
+    }
+    pthread_cond_broadcast(&reader_cond);
+    pthread_mutex_unlock(&reader_mutex);
+}
+
 // Initialize the database
 int init_database(const char *db_path) {
     int rc;
     char *err_msg = NULL;
     bool is_new_database = false;
     sqlite3 *test_db = NULL;
-    sqlite3_stmt *stmt = NULL;
 
     log_info("Initializing database at path: %s", db_path);
 
@@ -198,46 +910,33 @@ int init_database(const char *db_path) {
                 log_warn("No backup database file found, will create a new database");
             }
         } else {
-            // Run integrity check on the database
-            rc = sqlite3_prepare_v2(test_db, "PRAGMA integrity_check;", -1, &stmt, NULL);
-            if (rc == SQLITE_OK) {
-                if (sqlite3_step(stmt) == SQLITE_ROW) {
-                    const char *result = (const char *)sqlite3_column_text(stmt, 0);
-                    if (result && strcmp(result, "ok") != 0) {
-                        log_error("Database integrity check failed: %s", result);
-
-                        // Try to restore from backup
-                        if (stmt) {
-                            sqlite3_finalize(stmt);
-                            stmt = NULL;
-                        }
-
-                        if (test_db) {
-                            sqlite3_close_v2(test_db);
-                            test_db = NULL;
-                        }
-
-                        test_file = fopen(db_backup_path, "r");
-                        if (test_file) {
-                            log_info("Backup database file exists, attempting recovery");
-                            fclose(test_file);
-
-                            if (restore_database_from_backup(db_backup_path, db_path) != 0) {
-                                log_error("Failed to restore database from backup");
-                                // Continue anyway, we'll try to repair the database
-                            } else {
-                                log_info("Successfully restored database from backup");
-                            }
-                        } else {
-                            log_warn("No backup database file found, will attempt to repair");
-                        }
+            // A full integrity check reads the whole database and would delay
+            // recording by minutes on a large one; it runs in the background
+            // once the database is open
+            char problem[256] = {0};
+            if (database_fast_check(test_db, db_path, problem, sizeof(problem)) != 0) {
+                log_error("Database startup check failed: %s", problem);
+
+                sqlite3_close_v2(test_db);
+                test_db = NULL;
+
+                test_file = fopen(db_backup_path, "r");
+                if (test_file) {
+                    log_info("Backup database file exists, attempting recovery");
+                    fclose(test_file);
+
+                    if (restore_database_from_backup(db_backup_path, db_path) != 0) {
+                        log_error("Failed to restore database from backup");
+                        // Continue anyway, we'll try to repair the database
                     } else {
-                        log_info("Database integrity check passed");
+                        log_info("Successfully restored database from backup");
                     }
+                } else {
+                    log_warn("No backup database file found, will attempt to repair");
                 }
+            } else {
+                log_info("Database startup check passed");
             }
-            sqlite3_finalize(stmt);
-            stmt = NULL;
 
             if (test_db) {
                 // Release any cached schema before closing
@@ -318,6 +1017,14 @@ int init_database(const char *db_path) {
         // Continue anyway
     }
 
+    // Execution time, full scans and slow queries of every statement
+    trace_connection(db);
+
+    // Changed tables, counted per group for get_table_version()
+    sqlite3_update_hook(db, table_update_hook, NULL);
+    sqlite3_commit_hook(db, table_commit_hook, NULL);
+    sqlite3_rollback_hook(db, table_rollback_hook, NULL);
+
     // Enable WAL mode for better performance and crash resistance
     log_info("Enabling WAL mode for better crash resistance");
     rc = sqlite3_exec(db, "PRAGMA journal_mode=WAL;", NULL, NULL, &err_msg);
@@ -358,6 +1065,11 @@ int init_database(const char *db_path) {
         // Continue anyway
     }
 
+    if (db_cache_kb > 0 || db_mmap_mb > 0) {
+        log_info("Database page cache %d KiB, memory map %d MiB", db_cache_kb, db_mmap_mb);
+        apply_connection_sizes(db, db_cache_kb);
+    }
+
     // Enable auto_vacuum to keep the database file size manageable
     log_info("Enabling auto_vacuum");
     rc = sqlite3_exec(db, "PRAGMA auto_vacuum=INCREMENTAL;", NULL, NULL, &err_msg);
@@ -517,17 +1229,14 @@ int init_database(const char *db_path) {
         return -1;
     }
 
-    // Create indexes for faster queries
+    // Create indexes for faster queries; the indexes by stream are built on
+    // stream IDs by the schema migrations
     const char *create_indexes =
         "CREATE INDEX IF NOT EXISTS idx_events_timestamp ON events (timestamp);"
         "CREATE INDEX IF NOT EXISTS idx_events_type ON events (type);"
-        "CREATE INDEX IF NOT EXISTS idx_events_stream ON events (stream_name);"
         "CREATE INDEX IF NOT EXISTS idx_recordings_start_time ON recordings (start_time);"
         "CREATE INDEX IF NOT EXISTS idx_recordings_end_time ON recordings (end_time);"
-        "CREATE INDEX IF NOT EXISTS idx_recordings_stream ON recordings (stream_name);"
-        "CREATE INDEX IF NOT EXISTS idx_recordings_complete_stream_start ON recordings (is_complete, stream_name, start_time);"
         "CREATE INDEX IF NOT EXISTS idx_streams_name ON streams (name);"
-        "CREATE INDEX IF NOT EXISTS idx_detections_stream_timestamp ON detections (stream_name, timestamp);"
         "CREATE INDEX IF NOT EXISTS idx_detections_timestamp ON detections (timestamp);";
 
     rc = sqlite3_exec(db, create_indexes, NULL, NULL, &err_msg);
@@ -576,6 +1285,30 @@ int init_database(const char *db_path) {
 
     log_info("Database initialized successfully");
 
+    // API reads and checkpoints move off the writer connection, which needs WAL
+    if (wal_mode_enabled) {
+        open_db_readers(db_path);
+        start_checkpoint_thread(db_path);
+        // Replaces SQLite's own checkpoint on commit, and counts table
+        // changes once readers can see them
+        sqlite3_wal_hook(db, wal_commit_hook, NULL);
+    }
+
+    // The database may be a different file than the one open before
+    for (int i = 0; i < DB_TABLE_COUNT; i++) {
+        __atomic_fetch_add(&table_versions[i], 1, __ATOMIC_RELEASE);
+    }
+
+    // Detections from all streams are written in batches by one thread
+    if (init_detection_writer() != 0) {
+        log_warn("Detection writer not started, detections are written directly");
+    }
+
+    // Size and end time updates of recordings in progress are coalesced
+    if (init_recording_update_writer() != 0) {
+        log_warn("Recording update writer not started, updates are written directly");
+    }
+
     // Create an initial backup if this is a new database
     if (is_new_database) {
         log_info("Creating initial backup of new database");
@@ -585,6 +1318,8 @@ int init_database(const char *db_path) {
         } else {
             log_warn("Failed to create initial backup");
         }
+    } else {
+        start_integrity_check(db_path, INTEGRITY_CHECK_DELAY);
     }
 
     return 0;
@@ -611,6 +1346,21 @@ static void reset_sqlite_internal_state(void) {
 void shutdown_database(void) {
     log_info("Starting database shutdown process");
 
+    // Store queued detections while the database is still open
+    shutdown_detection_writer();
+    shutdown_recording_update_writer();
+
+    stop_integrity_check();
+    stop_database_backup();
+    close_db_readers();
+    stop_checkpoint_thread();
+
+    pthread_mutex_lock(&explain_mutex);
+    sqlite3_close_v2(explain_db);
+    explain_db = NULL;
+    explained_count = 0;
+    pthread_mutex_unlock(&explain_mutex);
+
     // Create a final backup before shutting down
     if (db != NULL && db_file_path[0] != '\0') {
         log_info("Creating final backup before shutdown");
@@ -669,7 +1419,8 @@ void shutdown_database(void) {
             }
         }
 
-        // No longer using tracked statements - we now rely on sqlite3_next_stmt to find all statements
+        // Cached statements first, so no dangling pointers are left behind
+        clear_stmt_cache();
 
         // Finalize all prepared statements before closing the database
         // This helps prevent "corrupted size vs. prev_size in fastbins" errors
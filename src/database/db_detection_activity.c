@@ -0,0 +1,242 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <sqlite3.h>
+
+#include "database/db_detection_activity.h"
+#include "database/db_core.h"
+#include "database/db_streams.h"
+#include "core/logger.h"
+
+// Labels of one stream and minute added by one batch
+typedef struct {
+    time_t minute;
+    const char *label;
+    int count;
+    float max_confidence;
+} activity_minute_t;
+
+int add_detection_activity(sqlite3 *db, const char *stream_name, const time_t *timestamps,
+                           const detection_t *detections, int count) {
+    if (!db || !stream_name || !timestamps || !detections || count <= 0) {
+        return -1;
+    }
+
+    activity_minute_t *minutes = malloc((size_t)count * sizeof(activity_minute_t));
+    if (!minutes) {
+        log_error("Failed to allocate memory for detection activity");
+        return -1;
+    }
+
+    // A batch holds a few labels over a few seconds, so a linear search is enough
+    int minute_count = 0;
+    for (int i = 0; i < count; i++) {
+        time_t minute = timestamps[i] - timestamps[i] % 60;
+        int m = 0;
+        while (m < minute_count && (minutes[m].minute != minute ||
+                                    strcmp(minutes[m].label, detections[i].label) != 0)) {
+            m++;
+        }
+        if (m == minute_count) {
+            minutes[m].minute = minute;
+            minutes[m].label = detections[i].label;
+            minutes[m].count = 0;
+            minutes[m].max_confidence = 0.0f;
+            minute_count++;
+        }
+        minutes[m].count++;
+        if (detections[i].confidence > minutes[m].max_confidence) {
+            minutes[m].max_confidence = detections[i].confidence;
+        }
+    }
+
+    // The stream may only have been stored in partitions or blocks so far
+    sqlite3_stmt *stmt = get_cached_stmt(DB_STMT_STREAM_ID_ADD,
+                                         "INSERT OR IGNORE INTO stream_ids (name) VALUES (?);");
+    if (!stmt) {
+        free(minutes);
+        return -1;
+    }
+    sqlite3_bind_text(stmt, 1, stream_name, -1, SQLITE_STATIC);
+    int rc = sqlite3_step(stmt);
+    release_cached_stmt(stmt);
+    if (rc != SQLITE_DONE) {
+        log_error("Failed to add stream ID for %s: %s", stream_name, sqlite3_errmsg(db));
+        free(minutes);
+        return -1;
+    }
+
+    stmt = get_cached_stmt(DB_STMT_DETECTION_ACTIVITY_ADD,
+                           "INSERT INTO detection_activity (stream_id, minute, label, count, max_confidence) "
+                           "VALUES (" STREAM_ID_OF("?1") ", ?2, ?3, ?4, ?5) "
+                           "ON CONFLICT (stream_id, minute, label) DO UPDATE SET "
+                           "count = count + excluded.count, "
+                           "max_confidence = MAX(max_confidence, excluded.max_confidence);");
+    if (!stmt) {
+        free(minutes);
+        return -1;
+    }
+
+    int ret = 0;
+    for (int m = 0; m < minute_count; m++) {
+        sqlite3_bind_text(stmt, 1, stream_name, -1, SQLITE_STATIC);
+        sqlite3_bind_int64(stmt, 2, (sqlite3_int64)minutes[m].minute);
+        sqlite3_bind_text(stmt, 3, minutes[m].label, -1, SQLITE_STATIC);
+        sqlite3_bind_int(stmt, 4, minutes[m].count);
+        sqlite3_bind_double(stmt, 5, minutes[m].max_confidence);
+        rc = sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+        if (rc != SQLITE_DONE) {
+            log_error("Failed to update detection activity: %s", sqlite3_errmsg(db));
+            ret = -1;
+            break;
+        }
+    }
+    release_cached_stmt(stmt);
+
+    free(minutes);
+    return ret;
+}
+
+/**
+ * Count a label in a bucket, keeping the most frequent labels
+ */
+static void add_bucket_label(activity_bucket_t *bucket, const char *label, int count, float max_confidence) {
+    int slot = bucket->label_count;
+    if (slot == ACTIVITY_MAX_LABELS) {
+        // Replace the least frequent label if this one is more frequent
+        slot = 0;
+        for (int i = 1; i < bucket->label_count; i++) {
+            if (bucket->labels[i].count < bucket->labels[slot].count) {
+                slot = i;
+            }
+        }
+        if (bucket->labels[slot].count >= count) {
+            return;
+        }
+    } else {
+        bucket->label_count++;
+    }
+
+    activity_label_t *l = &bucket->labels[slot];
+    snprintf(l->label, sizeof(l->label), "%s", label);
+    l->count = count;
+    l->max_confidence = max_confidence;
+}
+
+static int compare_labels(const void *a, const void *b) {
+    return ((const activity_label_t *)b)->count - ((const activity_label_t *)a)->count;
+}
+
+int get_detection_activity(const char *stream_name, time_t start_time, time_t end_time,
+                           int bucket_seconds, activity_bucket_t **buckets) {
+    if (!buckets || bucket_seconds < 60 || bucket_seconds % 60 != 0 || end_time <= start_time) {
+        log_error("Invalid parameters for get_detection_activity");
+        return -1;
+    }
+    *buckets = NULL;
+
+    sqlite3_int64 start = (sqlite3_int64)start_time - start_time % 60;
+    const char *sql = stream_name ?
+        "SELECT (minute - ?2) / ?4, label, SUM(count), MAX(max_confidence) "
+        "FROM detection_activity "
+        "WHERE stream_id = " STREAM_ID_OF("?1") " AND minute >= ?2 AND minute < ?3 "
+        "GROUP BY 1, 2 ORDER BY 1;" :
+        "SELECT (minute - ?2) / ?4, label, SUM(count), MAX(max_confidence) "
+        "FROM detection_activity "
+        "WHERE minute >= ?2 AND minute < ?3 "
+        "GROUP BY 1, 2 ORDER BY 1;";
+
+    sqlite3 *db = acquire_db_reader();
+    if (!db) {
+        return -1;
+    }
+
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+        release_db_reader(db);
+        return -1;
+    }
+    if (stream_name) {
+        sqlite3_bind_text(stmt, 1, stream_name, -1, SQLITE_STATIC);
+    }
+    sqlite3_bind_int64(stmt, 2, start);
+    sqlite3_bind_int64(stmt, 3, (sqlite3_int64)end_time);
+    sqlite3_bind_int(stmt, 4, bucket_seconds);
+
+    activity_bucket_t *result = NULL;
+    int count = 0, capacity = 0;
+    sqlite3_int64 current = -1;
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        sqlite3_int64 index = sqlite3_column_int64(stmt, 0);
+        if (index != current) {
+            if (count == capacity) {
+                capacity = capacity ? capacity * 2 : 64;
+                activity_bucket_t *grown = realloc(result, (size_t)capacity * sizeof(activity_bucket_t));
+                if (!grown) {
+                    log_error("Failed to allocate memory for detection activity");
+                    rc = SQLITE_NOMEM;
+                    break;
+                }
+                result = grown;
+            }
+            memset(&result[count], 0, sizeof(activity_bucket_t));
+            result[count].start = (time_t)(start + index * bucket_seconds);
+            count++;
+            current = index;
+        }
+
+        activity_bucket_t *bucket = &result[count - 1];
+        const char *label = (const char *)sqlite3_column_text(stmt, 1);
+        int label_count = sqlite3_column_int(stmt, 2);
+        float max_confidence = (float)sqlite3_column_double(stmt, 3);
+
+        bucket->count += label_count;
+        if (label && strcmp(label, ACTIVITY_MOTION_LABEL) == 0) {
+            bucket->motion = max_confidence;
+        }
+        add_bucket_label(bucket, label ? label : "unknown", label_count, max_confidence);
+    }
+    sqlite3_finalize(stmt);
+    release_db_reader(db);
+
+    if (rc != SQLITE_DONE) {
+        if (rc != SQLITE_NOMEM) {
+            log_error("Failed to read detection activity: %s", sqlite3_errstr(rc));
+        }
+        free(result);
+        return -1;
+    }
+
+    for (int i = 0; i < count; i++) {
+        qsort(result[i].labels, (size_t)result[i].label_count, sizeof(activity_label_t), compare_labels);
+    }
+
+    *buckets = result;
+    return count;
+}
+
+int delete_detection_activity_before(sqlite3 *db, time_t cutoff_time) {
+    if (!db) {
+        return -1;
+    }
+
+    // Only minutes that ended before the cutoff go, as with the detection blocks
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, "DELETE FROM detection_activity WHERE minute <= ?;", -1, &stmt, NULL) != SQLITE_OK) {
+        log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+        return -1;
+    }
+    sqlite3_bind_int64(stmt, 1, (sqlite3_int64)cutoff_time - 60);
+    int rc = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    if (rc != SQLITE_DONE) {
+        log_error("Failed to delete old detection activity: %s", sqlite3_errmsg(db));
+        return -1;
+    }
+    return sqlite3_changes(db);
+}
@@ -0,0 +1,401 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <sqlite3.h>
+
+#include "database/db_detection_blocks.h"
+#include "core/logger.h"
+
+// Label IDs fit the record's single byte; 0 is never assigned
+#define MAX_LABEL_ID 255
+
+// Label dictionary, indexed by ID; shared by the writer and reader connections
+static char label_names[MAX_LABEL_ID + 1][MAX_LABEL_LENGTH];
+static bool labels_loaded = false;
+static pthread_mutex_t labels_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void put_u16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)(v & 0xff);
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static uint16_t get_u16(const uint8_t *p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static void put_u32(uint8_t *p, uint32_t v) {
+    for (int i = 0; i < 4; i++) {
+        p[i] = (uint8_t)(v >> (8 * i));
+    }
+}
+
+static uint32_t get_u32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/**
+ * Quantize a normalized value to 0-max
+ */
+static unsigned int quantize(float value, unsigned int max) {
+    if (value <= 0.0f) {
+        return 0;
+    }
+    if (value >= 1.0f) {
+        return max;
+    }
+    return (unsigned int)(value * (float)max + 0.5f);
+}
+
+/**
+ * Read the dictionary, must be called with labels_mutex held
+ */
+static int load_labels(sqlite3 *db) {
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, "SELECT id, label FROM detection_labels;", -1, &stmt, NULL) != SQLITE_OK) {
+        log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+        return -1;
+    }
+
+    memset(label_names, 0, sizeof(label_names));
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        int id = sqlite3_column_int(stmt, 0);
+        const char *label = (const char *)sqlite3_column_text(stmt, 1);
+        if (id > 0 && id <= MAX_LABEL_ID && label) {
+            strncpy(label_names[id], label, MAX_LABEL_LENGTH - 1);
+        }
+    }
+    sqlite3_finalize(stmt);
+
+    labels_loaded = true;
+    return 0;
+}
+
+/**
+ * Get the dictionary ID of a label, adding it if it is new
+ *
+ * @return ID, 0 if the dictionary is full, -1 on error
+ */
+static int get_label_id(sqlite3 *db, const char *label) {
+    pthread_mutex_lock(&labels_mutex);
+    if (!labels_loaded && load_labels(db) != 0) {
+        pthread_mutex_unlock(&labels_mutex);
+        return -1;
+    }
+
+    for (int id = 1; id <= MAX_LABEL_ID; id++) {
+        if (label_names[id][0] && strcmp(label_names[id], label) == 0) {
+            pthread_mutex_unlock(&labels_mutex);
+            return id;
+        }
+    }
+    pthread_mutex_unlock(&labels_mutex);
+
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, "INSERT OR IGNORE INTO detection_labels (label) VALUES (?);",
+                           -1, &stmt, NULL) != SQLITE_OK) {
+        log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+        return -1;
+    }
+    sqlite3_bind_text(stmt, 1, label, -1, SQLITE_STATIC);
+    int rc = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    if (rc != SQLITE_DONE) {
+        log_error("Failed to add detection label %s: %s", label, sqlite3_errmsg(db));
+        return -1;
+    }
+
+    if (sqlite3_prepare_v2(db, "SELECT id FROM detection_labels WHERE label = ?;", -1, &stmt, NULL) != SQLITE_OK) {
+        log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+        return -1;
+    }
+    sqlite3_bind_text(stmt, 1, label, -1, SQLITE_STATIC);
+    int id = -1;
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        id = sqlite3_column_int(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+
+    if (id <= 0) {
+        return -1;
+    }
+    if (id > MAX_LABEL_ID) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&labels_mutex);
+    strncpy(label_names[id], label, MAX_LABEL_LENGTH - 1);
+    label_names[id][MAX_LABEL_LENGTH - 1] = '\0';
+    pthread_mutex_unlock(&labels_mutex);
+    return id;
+}
+
+/**
+ * Copy the label of a dictionary ID
+ */
+static void copy_label_name(sqlite3 *db, int id, char *label) {
+    if (id <= 0 || id > MAX_LABEL_ID) {
+        strcpy(label, "unknown");
+        return;
+    }
+
+    pthread_mutex_lock(&labels_mutex);
+    // Another connection may have added labels since they were loaded
+    if (!label_names[id][0]) {
+        load_labels(db);
+    }
+    strncpy(label, label_names[id][0] ? label_names[id] : "unknown", MAX_LABEL_LENGTH - 1);
+    label[MAX_LABEL_LENGTH - 1] = '\0';
+    pthread_mutex_unlock(&labels_mutex);
+}
+
+/**
+ * Append one minute's encoded records and update its summary
+ */
+static int append_minute(sqlite3 *db, const char *stream_name, time_t minute,
+                         const uint8_t *data, int count, uint32_t max_track_id,
+                         const int *label_ids, const float *confidences) {
+    sqlite3_stmt *stmt;
+    const char *block_sql =
+        "INSERT INTO detection_blocks (stream_name, minute, count, max_track_id, data) "
+        "VALUES (?, ?, ?, ?, ?) "
+        "ON CONFLICT (stream_name, minute) DO UPDATE SET "
+        "data = data || excluded.data, "
+        "count = count + excluded.count, "
+        "max_track_id = MAX(max_track_id, excluded.max_track_id);";
+
+    if (sqlite3_prepare_v2(db, block_sql, -1, &stmt, NULL) != SQLITE_OK) {
+        log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+        return -1;
+    }
+    sqlite3_bind_text(stmt, 1, stream_name, -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 2, (sqlite3_int64)minute);
+    sqlite3_bind_int(stmt, 3, count);
+    sqlite3_bind_int64(stmt, 4, (sqlite3_int64)max_track_id);
+    sqlite3_bind_blob(stmt, 5, data, count * DETECTION_RECORD_SIZE, SQLITE_STATIC);
+    int rc = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    if (rc != SQLITE_DONE) {
+        log_error("Failed to store detection block: %s", sqlite3_errmsg(db));
+        return -1;
+    }
+
+    const char *summary_sql =
+        "INSERT INTO detection_summary (stream_name, minute, label_id, count, max_confidence) "
+        "VALUES (?, ?, ?, 1, ?) "
+        "ON CONFLICT (stream_name, minute, label_id) DO UPDATE SET "
+        "count = count + 1, "
+        "max_confidence = MAX(max_confidence, excluded.max_confidence);";
+
+    if (sqlite3_prepare_v2(db, summary_sql, -1, &stmt, NULL) != SQLITE_OK) {
+        log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+        return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        sqlite3_bind_text(stmt, 1, stream_name, -1, SQLITE_STATIC);
+        sqlite3_bind_int64(stmt, 2, (sqlite3_int64)minute);
+        sqlite3_bind_int(stmt, 3, label_ids[i]);
+        sqlite3_bind_double(stmt, 4, confidences[i]);
+        rc = sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+        if (rc != SQLITE_DONE) {
+            log_error("Failed to update detection summary: %s", sqlite3_errmsg(db));
+            sqlite3_finalize(stmt);
+            return -1;
+        }
+    }
+    sqlite3_finalize(stmt);
+    return 0;
+}
+
+int store_detection_blocks(sqlite3 *db, const char *stream_name, const time_t *timestamps,
+                           const detection_t *detections, int count, bool *stored) {
+    if (!db || !stream_name || !timestamps || !detections || !stored || count <= 0) {
+        return -1;
+    }
+
+    uint8_t *data = malloc((size_t)count * DETECTION_RECORD_SIZE);
+    int *label_ids = malloc((size_t)count * sizeof(int));
+    float *confidences = malloc((size_t)count * sizeof(float));
+    if (!data || !label_ids || !confidences) {
+        log_error("Failed to allocate memory for detection block");
+        free(data);
+        free(label_ids);
+        free(confidences);
+        return -1;
+    }
+
+    int ret = 0;
+    int i = 0;
+    while (i < count && ret == 0) {
+        // Consecutive detections of the same minute become one append
+        time_t minute = timestamps[i] - timestamps[i] % 60;
+        int records = 0;
+        uint32_t max_track_id = 0;
+
+        for (; i < count && timestamps[i] - timestamps[i] % 60 == minute; i++) {
+            const detection_t *d = &detections[i];
+            int label_id = get_label_id(db, d->label);
+            if (label_id < 0) {
+                ret = -1;
+                break;
+            }
+
+            stored[i] = label_id > 0;
+            if (!stored[i]) {
+                continue;
+            }
+
+            uint8_t *r = data + records * DETECTION_RECORD_SIZE;
+            r[0] = (uint8_t)(timestamps[i] - minute);
+            r[1] = (uint8_t)label_id;
+            r[2] = (uint8_t)quantize(d->confidence, 255);
+            r[3] = 0;
+            put_u16(r + 4, (uint16_t)quantize(d->x, 65535));
+            put_u16(r + 6, (uint16_t)quantize(d->y, 65535));
+            put_u16(r + 8, (uint16_t)quantize(d->width, 65535));
+            put_u16(r + 10, (uint16_t)quantize(d->height, 65535));
+            put_u32(r + 12, d->track_id > 0 ? (uint32_t)d->track_id : 0);
+
+            if ((uint32_t)d->track_id > max_track_id && d->track_id > 0) {
+                max_track_id = (uint32_t)d->track_id;
+            }
+            label_ids[records] = label_id;
+            confidences[records] = d->confidence;
+            records++;
+        }
+
+        if (ret == 0 && records > 0) {
+            ret = append_minute(db, stream_name, minute, data, records, max_track_id, label_ids, confidences);
+        }
+    }
+
+    free(data);
+    free(label_ids);
+    free(confidences);
+    return ret;
+}
+
+int load_detection_blocks(sqlite3 *db, const char *stream_name, time_t start_time, time_t end_time,
+                          detection_t *detections, time_t *timestamps, int max_count) {
+    if (!db || !stream_name || !detections || !timestamps || max_count <= 0) {
+        return -1;
+    }
+
+    sqlite3_stmt *stmt;
+    const char *sql = "SELECT minute, data FROM detection_blocks "
+                      "WHERE stream_name = ? AND minute >= ? AND minute <= ? "
+                      "ORDER BY minute DESC;";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+        return -1;
+    }
+
+    sqlite3_int64 first_minute = start_time > 0 ? (sqlite3_int64)(start_time - start_time % 60) : 0;
+    sqlite3_int64 last_minute = end_time > 0 ? (sqlite3_int64)end_time : INT64_MAX;
+    sqlite3_bind_text(stmt, 1, stream_name, -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 2, first_minute);
+    sqlite3_bind_int64(stmt, 3, last_minute);
+
+    int count = 0;
+    while (count < max_count && sqlite3_step(stmt) == SQLITE_ROW) {
+        time_t minute = (time_t)sqlite3_column_int64(stmt, 0);
+        const uint8_t *data = sqlite3_column_blob(stmt, 1);
+        int records = sqlite3_column_bytes(stmt, 1) / DETECTION_RECORD_SIZE;
+
+        // Records are appended in time order, so the newest are at the end
+        for (int i = records - 1; i >= 0 && count < max_count; i--) {
+            const uint8_t *r = data + i * DETECTION_RECORD_SIZE;
+            time_t timestamp = minute + r[0];
+            if ((start_time > 0 && timestamp < start_time) || (end_time > 0 && timestamp > end_time)) {
+                continue;
+            }
+
+            detection_t *d = &detections[count];
+            copy_label_name(db, r[1], d->label);
+            d->confidence = (float)r[2] / 255.0f;
+            d->x = (float)get_u16(r + 4) / 65535.0f;
+            d->y = (float)get_u16(r + 6) / 65535.0f;
+            d->width = (float)get_u16(r + 8) / 65535.0f;
+            d->height = (float)get_u16(r + 10) / 65535.0f;
+            d->track_id = (int)get_u32(r + 12);
+            timestamps[count] = timestamp;
+            count++;
+        }
+    }
+
+    sqlite3_finalize(stmt);
+    return count;
+}
+
+int delete_detection_blocks_before(sqlite3 *db, time_t cutoff_time) {
+    if (!db) {
+        return -1;
+    }
+
+    // Only minutes that ended before the cutoff go; a partial minute is kept
+    sqlite3_int64 last_minute = (sqlite3_int64)cutoff_time - 60;
+    int deleted = 0;
+
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, "SELECT COALESCE(SUM(count), 0) FROM detection_blocks WHERE minute <= ?;",
+                           -1, &stmt, NULL) != SQLITE_OK) {
+        log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+        return -1;
+    }
+    sqlite3_bind_int64(stmt, 1, last_minute);
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        deleted = sqlite3_column_int(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+
+    const char *tables[] = {
+        "DELETE FROM detection_blocks WHERE minute <= ?;",
+        "DELETE FROM detection_summary WHERE minute <= ?;"
+    };
+    for (int i = 0; i < 2; i++) {
+        if (sqlite3_prepare_v2(db, tables[i], -1, &stmt, NULL) != SQLITE_OK) {
+            log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+            return -1;
+        }
+        sqlite3_bind_int64(stmt, 1, last_minute);
+        int rc = sqlite3_step(stmt);
+        sqlite3_finalize(stmt);
+        if (rc != SQLITE_DONE) {
+            log_error("Failed to delete old detection blocks: %s", sqlite3_errmsg(db));
+            return -1;
+        }
+    }
+
+    return deleted;
+}
+
+int get_detection_blocks_max_track_id(sqlite3 *db) {
+    if (!db) {
+        return -1;
+    }
+
+    sqlite3_stmt *stmt;
+    const char *sql = "SELECT MAX(max_track_id) FROM "
+                      "(SELECT max_track_id FROM detection_blocks ORDER BY minute DESC LIMIT 1000);";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+        return -1;
+    }
+
+    int max_id = 0;
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        max_id = sqlite3_column_int(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+    return max_id;
+}
+
+void reset_detection_labels(void) {
+    pthread_mutex_lock(&labels_mutex);
+    memset(label_names, 0, sizeof(label_names));
+    labels_loaded = false;
+    pthread_mutex_unlock(&labels_mutex);
+}
@@ -0,0 +1,402 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <sqlite3.h>
+
+#include "database/db_detection_search.h"
+#include "database/db_detection_blocks.h"
+#include "database/db_partitions.h"
+#include "database/db_streams.h"
+#include "database/db_core.h"
+#include "core/logger.h"
+
+// Days of partitions searched at most, newest first
+#define SEARCH_MAX_PARTITIONS 366
+
+// Records read from one compact block minute at most
+#define SEARCH_BLOCK_RECORDS 4096
+
+// Where a result was found, in the order results of the same second are returned
+enum {
+    SOURCE_TABLE = 0,
+    SOURCE_PARTITION,
+    SOURCE_BLOCK
+};
+
+typedef struct {
+    detection_search_result_t result;
+    int source;
+    sqlite3_int64 seq;              // Row ID, or position within a block minute
+} found_t;
+
+typedef struct {
+    found_t *items;
+    int count;
+    int capacity;
+} found_list_t;
+
+// Matches a stream_name column against the comma-separated streams of ?5
+#define STREAM_FILTER(column) "(?5 IS NULL OR instr(',' || ?5 || ',', ',' || " column " || ',') > 0)"
+
+static found_t *add_found(found_list_t *list) {
+    if (list->count == list->capacity) {
+        int capacity = list->capacity ? list->capacity * 2 : 64;
+        found_t *grown = realloc(list->items, (size_t)capacity * sizeof(found_t));
+        if (!grown) {
+            log_error("Failed to allocate memory for detection search");
+            return NULL;
+        }
+        list->items = grown;
+        list->capacity = capacity;
+    }
+    found_t *found = &list->items[list->count++];
+    memset(found, 0, sizeof(*found));
+    return found;
+}
+
+/**
+ * Read rows selected as timestamp, label, confidence, x, y, width, height,
+ * track_id, stream_name, id
+ *
+ * @return Number of rows read, or -1 on error
+ */
+static int read_search_rows(sqlite3_stmt *stmt, int source, found_list_t *list) {
+    int count = 0;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        found_t *found = add_found(list);
+        if (!found) {
+            return -1;
+        }
+
+        detection_search_result_t *r = &found->result;
+        const char *label = (const char *)sqlite3_column_text(stmt, 1);
+        const char *stream = (const char *)sqlite3_column_text(stmt, 8);
+        r->timestamp = (time_t)sqlite3_column_int64(stmt, 0);
+        strncpy(r->detection.label, label ? label : "unknown", MAX_LABEL_LENGTH - 1);
+        r->detection.confidence = (float)sqlite3_column_double(stmt, 2);
+        r->detection.x = (float)sqlite3_column_double(stmt, 3);
+        r->detection.y = (float)sqlite3_column_double(stmt, 4);
+        r->detection.width = (float)sqlite3_column_double(stmt, 5);
+        r->detection.height = (float)sqlite3_column_double(stmt, 6);
+        r->detection.track_id = sqlite3_column_int(stmt, 7);
+        strncpy(r->stream_name, stream ? stream : "", MAX_STREAM_NAME - 1);
+        found->source = source;
+        found->seq = sqlite3_column_int64(stmt, 9);
+        count++;
+    }
+    return count;
+}
+
+static void bind_filters(sqlite3_stmt *stmt, const detection_search_query_t *query,
+                         sqlite3_int64 start, sqlite3_int64 end) {
+    sqlite3_bind_text(stmt, 1, query->label, -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 2, start);
+    sqlite3_bind_int64(stmt, 3, end);
+    sqlite3_bind_double(stmt, 4, query->min_confidence);
+    if (query->streams) {
+        sqlite3_bind_text(stmt, 5, query->streams, -1, SQLITE_STATIC);
+    } else {
+        sqlite3_bind_null(stmt, 5);
+    }
+}
+
+/**
+ * Search the detections table through its (label_id, timestamp) index
+ */
+static int search_table(sqlite3 *db, const detection_search_query_t *query, sqlite3_int64 end,
+                        int need, found_list_t *list) {
+    const char *sql = "SELECT timestamp, label, confidence, x, y, width, height, track_id, stream_name, id "
+                      "FROM detections "
+                      "WHERE label_id = " LABEL_ID_OF("?1") " AND timestamp >= ?2 AND timestamp <= ?3 "
+                      "AND confidence >= ?4 AND " STREAM_FILTER("stream_name") " "
+                      "ORDER BY timestamp DESC, id DESC "
+                      "LIMIT ?6;";
+
+    sqlite3_stmt *stmt = get_reader_cached_stmt(db, DB_STMT_DETECTION_SEARCH, sql);
+    if (!stmt) {
+        return -1;
+    }
+    bind_filters(stmt, query, (sqlite3_int64)query->start_time, end);
+    sqlite3_bind_int(stmt, 6, need);
+
+    int rc = read_search_rows(stmt, SOURCE_TABLE, list);
+    release_cached_stmt(stmt);
+    return rc < 0 ? -1 : 0;
+}
+
+/**
+ * Search the day partitions, reading only the minutes of each stream whose
+ * activity holds the label
+ * Minutes are read newest first until need results are found and the
+ * minute they end in is complete.
+ */
+static int search_partitions(sqlite3 *db, const detection_search_query_t *query, sqlite3_int64 end,
+                             int need, found_list_t *list) {
+    int days[SEARCH_MAX_PARTITIONS];
+    int partitions = list_partitions(db, "detections", partition_day(query->start_time),
+                                     partition_day((time_t)end), days, SEARCH_MAX_PARTITIONS);
+    if (partitions <= 0) {
+        return partitions;
+    }
+
+    sqlite3_stmt *minutes;
+    const char *minutes_sql =
+        "SELECT s.name, a.minute FROM detection_activity a JOIN stream_ids s ON s.id = a.stream_id "
+        "WHERE a.label = ?1 AND a.minute >= ?2 AND a.minute <= ?3 AND a.max_confidence >= ?4 "
+        "AND " STREAM_FILTER("s.name") " "
+        "ORDER BY a.minute DESC, s.name;";
+    if (sqlite3_prepare_v2(db, minutes_sql, -1, &minutes, NULL) != SQLITE_OK) {
+        log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+        return -1;
+    }
+
+    int found = 0;
+    int ret = 0;
+    for (int p = 0; p < partitions && found < need && ret == 0; p++) {
+        sqlite3_int64 day_start = (sqlite3_int64)days[p] * 86400;
+        sqlite3_int64 first = day_start > query->start_time ? day_start : (sqlite3_int64)query->start_time;
+        sqlite3_int64 last = day_start + 86399 < end ? day_start + 86399 : end;
+
+        char name[MAX_PARTITION_NAME];
+        partition_name("detections", days[p], name, sizeof(name));
+        char sql[384];
+        snprintf(sql, sizeof(sql),
+                 "SELECT timestamp, label, confidence, x, y, width, height, track_id, stream_name, id "
+                 "FROM \"%s\" "
+                 "WHERE stream_name = ?1 AND timestamp >= ?2 AND timestamp <= ?3 "
+                 "AND label = ?4 AND confidence >= ?5 "
+                 "ORDER BY timestamp DESC, id DESC;", name);
+
+        sqlite3_stmt *rows;
+        if (sqlite3_prepare_v2(db, sql, -1, &rows, NULL) != SQLITE_OK) {
+            log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+            ret = -1;
+            break;
+        }
+
+        sqlite3_reset(minutes);
+        bind_filters(minutes, query, first - first % 60, last);
+        sqlite3_int64 current_minute = -1;
+        while (sqlite3_step(minutes) == SQLITE_ROW) {
+            sqlite3_int64 minute = sqlite3_column_int64(minutes, 1);
+            if (found >= need && minute != current_minute) {
+                break;
+            }
+            current_minute = minute;
+
+            sqlite3_reset(rows);
+            sqlite3_bind_text(rows, 1, (const char *)sqlite3_column_text(minutes, 0), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_int64(rows, 2, minute > first ? minute : first);
+            sqlite3_bind_int64(rows, 3, minute + 59 < last ? minute + 59 : last);
+            sqlite3_bind_text(rows, 4, query->label, -1, SQLITE_STATIC);
+            sqlite3_bind_double(rows, 5, query->min_confidence);
+
+            int count = read_search_rows(rows, SOURCE_PARTITION, list);
+            if (count < 0) {
+                ret = -1;
+                break;
+            }
+            found += count;
+        }
+        sqlite3_finalize(rows);
+    }
+
+    sqlite3_finalize(minutes);
+    return ret;
+}
+
+/**
+ * Search the compact blocks, reading only the minutes whose summary holds
+ * the label
+ */
+static int search_blocks(sqlite3 *db, const detection_search_query_t *query, sqlite3_int64 end,
+                         int need, found_list_t *list) {
+    sqlite3_stmt *minutes;
+    const char *sql =
+        "SELECT stream_name, minute FROM detection_summary "
+        "WHERE label_id = " LABEL_ID_OF("?1") " AND minute >= ?2 AND minute <= ?3 AND max_confidence >= ?4 "
+        "AND " STREAM_FILTER("stream_name") " "
+        "ORDER BY minute DESC, stream_name;";
+    if (sqlite3_prepare_v2(db, sql, -1, &minutes, NULL) != SQLITE_OK) {
+        log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+        return -1;
+    }
+    bind_filters(minutes, query, (sqlite3_int64)(query->start_time - query->start_time % 60), end);
+
+    detection_t *detections = NULL;
+    time_t *timestamps = NULL;
+    int found = 0;
+    int ret = 0;
+    sqlite3_int64 current_minute = -1;
+    while (sqlite3_step(minutes) == SQLITE_ROW) {
+        sqlite3_int64 minute = sqlite3_column_int64(minutes, 1);
+        if (found >= need && minute != current_minute) {
+            break;
+        }
+        current_minute = minute;
+
+        // Most searches never get here, so the buffers are only allocated now
+        if (!detections) {
+            detections = malloc(SEARCH_BLOCK_RECORDS * sizeof(detection_t));
+            timestamps = malloc(SEARCH_BLOCK_RECORDS * sizeof(time_t));
+            if (!detections || !timestamps) {
+                log_error("Failed to allocate memory for detection search");
+                ret = -1;
+                break;
+            }
+        }
+
+        const char *stream = (const char *)sqlite3_column_text(minutes, 0);
+        time_t first = minute > query->start_time ? (time_t)minute : query->start_time;
+        time_t last = minute + 59 < end ? (time_t)(minute + 59) : (time_t)end;
+        int count = load_detection_blocks(db, stream, first, last, detections, timestamps, SEARCH_BLOCK_RECORDS);
+        for (int i = 0; i < count; i++) {
+            // Blocks store confidence in 1/255 steps, rounded down
+            if (strcmp(detections[i].label, query->label) != 0 ||
+                detections[i].confidence + 0.5f / 255.0f < query->min_confidence) {
+                continue;
+            }
+
+            found_t *f = add_found(list);
+            if (!f) {
+                ret = -1;
+                break;
+            }
+            f->result.timestamp = timestamps[i];
+            f->result.detection = detections[i];
+            strncpy(f->result.stream_name, stream, MAX_STREAM_NAME - 1);
+            f->source = SOURCE_BLOCK;
+            f->seq = count - i;
+            found++;
+        }
+        if (ret != 0) {
+            break;
+        }
+    }
+
+    free(detections);
+    free(timestamps);
+    sqlite3_finalize(minutes);
+    return ret;
+}
+
+// Newest first; results of the same second in the order the sources return them
+static int compare_found(const void *a, const void *b) {
+    const found_t *fa = a;
+    const found_t *fb = b;
+    if (fa->result.timestamp != fb->result.timestamp) {
+        return fa->result.timestamp < fb->result.timestamp ? 1 : -1;
+    }
+    if (fa->source != fb->source) {
+        return fa->source - fb->source;
+    }
+    if (fa->source != SOURCE_TABLE) {
+        int c = strcmp(fa->result.stream_name, fb->result.stream_name);
+        if (c != 0) {
+            return c;
+        }
+    }
+    return (fa->seq < fb->seq) - (fa->seq > fb->seq);
+}
+
+/**
+ * Find the recording of the stream covering a result
+ */
+static void find_recording(sqlite3 *db, detection_search_result_t *r) {
+    const char *sql = "SELECT id, start_time, end_time, is_complete FROM recordings "
+                      "WHERE stream_id = " STREAM_ID_OF("?1") " AND start_time <= ?2 "
+                      "ORDER BY start_time DESC "
+                      "LIMIT 1;";
+
+    sqlite3_stmt *stmt = get_reader_cached_stmt(db, DB_STMT_DETECTION_RECORDING, sql);
+    if (!stmt) {
+        return;
+    }
+    sqlite3_bind_text(stmt, 1, r->stream_name, -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 2, (sqlite3_int64)r->timestamp);
+
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        // A recording still being written has no end yet
+        bool complete = sqlite3_column_int(stmt, 3) != 0;
+        if (!complete || sqlite3_column_int64(stmt, 2) >= (sqlite3_int64)r->timestamp) {
+            r->recording_id = (uint64_t)sqlite3_column_int64(stmt, 0);
+            r->recording_start = (time_t)sqlite3_column_int64(stmt, 1);
+        }
+    }
+    release_cached_stmt(stmt);
+}
+
+int search_detections(const detection_search_query_t *query, detection_search_result_t *results,
+                      time_t *next_time, int *next_skip, bool *more) {
+    if (!query || !query->label || !results || !next_time || !next_skip || !more ||
+        query->limit <= 0 || query->limit > DETECTION_SEARCH_MAX_RESULTS || query->cursor_skip < 0) {
+        log_error("Invalid parameters for search_detections");
+        return -1;
+    }
+    *next_time = 0;
+    *next_skip = 0;
+    *more = false;
+
+    // A page continues at the second it ended in
+    sqlite3_int64 end = query->end_time > 0 ? (sqlite3_int64)query->end_time : INT32_MAX;
+    if (query->cursor_time > 0 && query->cursor_time < end) {
+        end = (sqlite3_int64)query->cursor_time;
+    }
+    if (end < query->start_time) {
+        return 0;
+    }
+    int need = query->limit + 1 + query->cursor_skip;
+
+    sqlite3 *db = acquire_db_reader();
+    if (!db) {
+        return -1;
+    }
+
+    // Every source holds its need newest results, so the merged need newest
+    // are among them
+    found_list_t list = {0};
+    if (search_table(db, query, end, need, &list) != 0 ||
+        search_partitions(db, query, end, need, &list) != 0 ||
+        search_blocks(db, query, end, need, &list) != 0) {
+        release_db_reader(db);
+        free(list.items);
+        return -1;
+    }
+
+    if (list.count > 1) {
+        qsort(list.items, (size_t)list.count, sizeof(found_t), compare_found);
+    }
+
+    int first = 0;
+    if (query->cursor_time > 0) {
+        while (first < list.count && first < query->cursor_skip &&
+               list.items[first].result.timestamp == query->cursor_time) {
+            first++;
+        }
+    }
+
+    int count = 0;
+    while (count < query->limit && first + count < list.count) {
+        results[count] = list.items[first + count].result;
+        find_recording(db, &results[count]);
+        count++;
+    }
+    release_db_reader(db);
+
+    if (count > 0) {
+        *more = first + count < list.count;
+        *next_time = results[count - 1].timestamp;
+        for (int i = count - 1; i >= 0 && results[i].timestamp == *next_time; i--) {
+            (*next_skip)++;
+        }
+        if (*next_time == query->cursor_time) {
+            *next_skip += first;
+        }
+    }
+
+    free(list.items);
+    return count;
+}
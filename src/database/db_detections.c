@@ -5,170 +5,300 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include <time.h>
 #include <sqlite3.h>
 #include <stdbool.h>
 #include <math.h>
+#include <pthread.h>
 
 #include "database/db_detections.h"
 #include "database/db_core.h"
+#include "database/db_detection_blocks.h"
+#include "database/db_detection_activity.h"
+#include "database/db_detection_search.h"
+#include "database/db_partitions.h"
+#include "database/db_streams.h"
 #include "core/logger.h"
+#include "core/config.h"
+#include "core/pipeline_trace.h"
 #include "video/detection_result.h"
 
+// Rows the write queue holds; detections arriving while it is full are dropped
+#define DETECTION_QUEUE_SIZE 2048
+
+// A batch is committed after this many milliseconds or this many rows, whichever comes first
+#define DETECTION_BATCH_MS 250
+#define DETECTION_BATCH_ROWS 256
+
+// Detection waiting for the writer thread
+typedef struct {
+    char stream_name[MAX_STREAM_NAME];
+    time_t timestamp;
+    detection_t detection;
+    pipeline_trace_t trace;     // Frame the detection was found in
+} queued_detection_t;
+
+static queued_detection_t detection_queue[DETECTION_QUEUE_SIZE];
+static int queue_head = 0;                  // Oldest queued row
+static int queue_count = 0;
+static unsigned long dropped_detections = 0;
+static uint64_t written_total = 0;          // Since start, for get_detection_writer_stats()
+static uint64_t dropped_total = 0;
+static pthread_mutex_t queue_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+
+static pthread_t writer_thread;
+static bool writer_running = false;
+
+// Owned by the writer thread
+static queued_detection_t writer_batch[DETECTION_BATCH_ROWS];
+
+// Whether the detections table is known to exist, guarded by the database mutex
+static bool detections_table_checked = false;
+
+// Schema of the day partitions, see db_partitions.h
+#define DETECTION_PARTITION_COLUMNS \
+    "id INTEGER PRIMARY KEY, stream_name TEXT NOT NULL, timestamp INTEGER NOT NULL, " \
+    "label TEXT NOT NULL, confidence REAL NOT NULL, x REAL NOT NULL, y REAL NOT NULL, " \
+    "width REAL NOT NULL, height REAL NOT NULL, track_id INTEGER DEFAULT 0"
+#define DETECTION_PARTITION_INDEX "stream_name, timestamp"
+
 /**
- * Store detection results in the database
- * 
- * @param stream_name Stream name
- * @param result Detection results
- * @param timestamp Timestamp of the detection (0 for current time)
- * @return 0 on success, non-zero on failure
+ * Make sure the detections table exists
+ * Must be called with the database mutex held.
  */
-int store_detections_in_db(const char *stream_name, const detection_result_t *result, time_t timestamp) {
-    int rc;
-    sqlite3_stmt *stmt;
-    
-    sqlite3 *db = get_db_handle();
-    pthread_mutex_t *db_mutex = get_db_mutex();
-    
-    if (!db) {
-        log_error("Database not initialized when trying to store detections");
-        return -1;
-    }
-    
-    if (!stream_name || !result) {
-        log_error("Invalid parameters for store_detections_in_db: stream_name=%p, result=%p", 
-                 stream_name, result);
-        return -1;
-    }
-    
-    // Use current time if timestamp is 0
-    if (timestamp == 0) {
-        timestamp = time(NULL);
-    }
-    
-    log_info("Storing %d detections in database for stream %s", result->count, stream_name);
-    
-    // Log the first detection for debugging
-    if (result->count > 0) {
-        log_info("First detection: %s (%.2f%%) at [%.2f, %.2f, %.2f, %.2f]",
-                result->detections[0].label,
-                result->detections[0].confidence * 100.0f,
-                result->detections[0].x,
-                result->detections[0].y,
-                result->detections[0].width,
-                result->detections[0].height);
-    }
-    
-    pthread_mutex_lock(db_mutex);
-    
-    // Check if detections table exists
+static int ensure_detections_table(sqlite3 *db) {
     char *err_msg = NULL;
     char **query_result;
     int rows, cols;
-    rc = sqlite3_get_table(db, 
-                          "SELECT name FROM sqlite_master WHERE type='table' AND name='detections';", 
-                          &query_result, &rows, &cols, &err_msg);
-    
+    int rc = sqlite3_get_table(db,
+                               "SELECT name FROM sqlite_master WHERE type='table' AND name='detections';",
+                               &query_result, &rows, &cols, &err_msg);
     if (rc != SQLITE_OK) {
         log_error("Failed to check if detections table exists: %s", err_msg);
         sqlite3_free(err_msg);
-        pthread_mutex_unlock(db_mutex);
         return -1;
     }
-    
-    if (rows == 0) {
-        log_error("Detections table does not exist, recreating it");
-        sqlite3_free_table(query_result);
-        
-        // Create detections table
-        const char *create_detections_table = 
-            "CREATE TABLE IF NOT EXISTS detections ("
-            "id INTEGER PRIMARY KEY AUTOINCREMENT,"
-            "stream_name TEXT NOT NULL,"
-            "timestamp INTEGER NOT NULL,"
-            "label TEXT NOT NULL,"
-            "confidence REAL NOT NULL,"
-            "x REAL NOT NULL,"
-            "y REAL NOT NULL,"
-            "width REAL NOT NULL,"
-            "height REAL NOT NULL"
-            ");";
-        
-        rc = sqlite3_exec(db, create_detections_table, NULL, NULL, &err_msg);
-        if (rc != SQLITE_OK) {
-            log_error("Failed to create detections table: %s", err_msg);
-            sqlite3_free(err_msg);
-            pthread_mutex_unlock(db_mutex);
+    sqlite3_free_table(query_result);
+
+    if (rows > 0) {
+        return 0;
+    }
+
+    log_error("Detections table does not exist, recreating it");
+
+    const char *create_detections_table =
+        "CREATE TABLE IF NOT EXISTS detections ("
+        "id INTEGER PRIMARY KEY AUTOINCREMENT,"
+        "stream_name TEXT NOT NULL,"
+        "timestamp INTEGER NOT NULL,"
+        "label TEXT NOT NULL,"
+        "confidence REAL NOT NULL,"
+        "x REAL NOT NULL,"
+        "y REAL NOT NULL,"
+        "width REAL NOT NULL,"
+        "height REAL NOT NULL,"
+        "track_id INTEGER DEFAULT 0,"
+        "stream_id INTEGER,"
+        "label_id INTEGER"
+        ");"
+        "CREATE INDEX IF NOT EXISTS idx_detections_stream_timestamp ON detections (stream_id, timestamp);"
+        "CREATE INDEX IF NOT EXISTS idx_detections_timestamp ON detections (timestamp);"
+        "CREATE INDEX IF NOT EXISTS idx_detections_label_timestamp ON detections (label_id, timestamp);"
+        STREAM_ID_TRIGGER_SQL("detections")
+        LABEL_ID_TRIGGER_SQL("detections");
+
+    rc = sqlite3_exec(db, create_detections_table, NULL, NULL, &err_msg);
+    if (rc != SQLITE_OK) {
+        log_error("Failed to create detections table: %s", err_msg);
+        sqlite3_free(err_msg);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Insert one detection with the cached statement
+ */
+static int insert_detection_row(sqlite3_stmt *insert_stmt, const queued_detection_t *row) {
+    const detection_t *d = &row->detection;
+    sqlite3_bind_text(insert_stmt, 1, row->stream_name, -1, SQLITE_STATIC);
+    sqlite3_bind_int64(insert_stmt, 2, (sqlite3_int64)row->timestamp);
+    sqlite3_bind_text(insert_stmt, 3, d->label, -1, SQLITE_STATIC);
+    sqlite3_bind_double(insert_stmt, 4, d->confidence);
+    sqlite3_bind_double(insert_stmt, 5, d->x);
+    sqlite3_bind_double(insert_stmt, 6, d->y);
+    sqlite3_bind_double(insert_stmt, 7, d->width);
+    sqlite3_bind_double(insert_stmt, 8, d->height);
+    sqlite3_bind_int(insert_stmt, 9, d->track_id);
+
+    int rc = sqlite3_step(insert_stmt);
+    release_cached_stmt(insert_stmt);
+    return rc == SQLITE_DONE ? 0 : -1;
+}
+
+/**
+ * Append rows to the compact minute blocks, one append per run of a stream
+ *
+ * @param stored Receives for each row whether it was stored
+ */
+static int store_compact_detections(sqlite3 *db, const queued_detection_t *rows, int count, bool *stored) {
+    time_t timestamps[DETECTION_BATCH_ROWS];
+    detection_t detections[DETECTION_BATCH_ROWS];
+
+    int start = 0;
+    while (start < count) {
+        int end = start;
+        while (end < count && end - start < DETECTION_BATCH_ROWS &&
+               strcmp(rows[end].stream_name, rows[start].stream_name) == 0) {
+            timestamps[end - start] = rows[end].timestamp;
+            detections[end - start] = rows[end].detection;
+            end++;
+        }
+
+        if (store_detection_blocks(db, rows[start].stream_name, timestamps, detections,
+                                   end - start, stored + start) != 0) {
             return -1;
         }
-        
-        // Create indexes
-        const char *create_indexes = 
-            "CREATE INDEX IF NOT EXISTS idx_detections_stream_timestamp ON detections (stream_name, timestamp);"
-            "CREATE INDEX IF NOT EXISTS idx_detections_timestamp ON detections (timestamp);";
-        
-        rc = sqlite3_exec(db, create_indexes, NULL, NULL, &err_msg);
-        if (rc != SQLITE_OK) {
-            log_error("Failed to create indexes: %s", err_msg);
-            sqlite3_free(err_msg);
-            pthread_mutex_unlock(db_mutex);
+        start = end;
+    }
+    return 0;
+}
+
+/**
+ * Add rows to the per-minute activity, one call per run of a stream
+ */
+static int store_detection_activity(sqlite3 *db, const queued_detection_t *rows, int count) {
+    time_t timestamps[DETECTION_BATCH_ROWS];
+    detection_t detections[DETECTION_BATCH_ROWS];
+
+    int start = 0;
+    while (start < count) {
+        int end = start;
+        while (end < count && end - start < DETECTION_BATCH_ROWS &&
+               strcmp(rows[end].stream_name, rows[start].stream_name) == 0) {
+            timestamps[end - start] = rows[end].timestamp;
+            detections[end - start] = rows[end].detection;
+            end++;
+        }
+
+        if (add_detection_activity(db, rows[start].stream_name, timestamps, detections, end - start) != 0) {
             return -1;
         }
+        start = end;
+    }
+    return 0;
+}
+
+/**
+ * Get the cached insert statement for the detections table or a day's partition
+ * Must be called with the database mutex held, after the partition was ensured.
+ *
+ * @param day Partition day, or -1 for the detections table
+ */
+static sqlite3_stmt *prepare_detection_insert(int day) {
+    const char *columns = "(stream_name, timestamp, label, confidence, x, y, width, height, track_id) "
+                          "VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9);";
+    char sql[448];
+
+    if (day < 0) {
+        // Streams and labels seen before get their IDs here, saving the triggers' updates
+        snprintf(sql, sizeof(sql),
+                 "INSERT INTO detections (stream_name, timestamp, label, confidence, x, y, width, height, "
+                 "track_id, stream_id, label_id) VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9, "
+                 STREAM_ID_OF("?1") ", " LABEL_ID_OF("?3") ");");
     } else {
-        sqlite3_free_table(query_result);
+        char name[MAX_PARTITION_NAME];
+        partition_name("detections", day, name, sizeof(name));
+        snprintf(sql, sizeof(sql), "INSERT INTO \"%s\" %s", name, columns);
     }
-    
-    // Begin transaction for better performance when inserting multiple detections
-    rc = sqlite3_exec(db, "BEGIN TRANSACTION;", NULL, NULL, &err_msg);
+    return get_cached_stmt(DB_STMT_DETECTION_INSERT, sql);
+}
+
+/**
+ * Insert rows in a single transaction
+ * The insert statement comes from the statement cache.
+ *
+ * @return 0 on success, -1 on failure (nothing is stored)
+ */
+static int write_detection_batch(const queued_detection_t *rows, int count) {
+    sqlite3 *db = get_db_handle();
+    pthread_mutex_t *db_mutex = get_db_mutex();
+
+    if (!db) {
+        log_error("Database not initialized when trying to store detections");
+        return -1;
+    }
+
+    lock_db_mutex();
+
+    if (!detections_table_checked) {
+        if (ensure_detections_table(db) != 0) {
+            pthread_mutex_unlock(db_mutex);
+            return -1;
+        }
+        detections_table_checked = true;
+    }
+
+    // Created outside the transaction so a rollback cannot undo a partition
+    // that is already remembered as existing
+    if (g_config.db_partition_by_day) {
+        for (int i = 0; i < count; i++) {
+            if (ensure_partition(db, "detections", partition_day(rows[i].timestamp),
+                                 DETECTION_PARTITION_COLUMNS, DETECTION_PARTITION_INDEX) != 0) {
+                pthread_mutex_unlock(db_mutex);
+                return -1;
+            }
+        }
+    }
+
+    char *err_msg = NULL;
+    int rc = sqlite3_exec(db, "BEGIN TRANSACTION;", NULL, NULL, &err_msg);
     if (rc != SQLITE_OK) {
         log_error("Failed to begin transaction: %s", err_msg);
         sqlite3_free(err_msg);
         pthread_mutex_unlock(db_mutex);
         return -1;
     }
-    
-    const char *sql = "INSERT INTO detections (stream_name, timestamp, label, confidence, x, y, width, height) "
-                      "VALUES (?, ?, ?, ?, ?, ?, ?, ?);";
-    
-    rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
-        log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+
+    bool stored[DETECTION_BATCH_ROWS] = {false};
+    if (g_config.db_compact_detections && store_compact_detections(db, rows, count, stored) != 0) {
         sqlite3_exec(db, "ROLLBACK;", NULL, NULL, NULL);
         pthread_mutex_unlock(db_mutex);
         return -1;
     }
-    
-    // Insert each detection
-    for (int i = 0; i < result->count; i++) {
-        // Bind parameters
-        sqlite3_bind_text(stmt, 1, stream_name, -1, SQLITE_STATIC);
-        sqlite3_bind_int64(stmt, 2, (sqlite3_int64)timestamp);
-        sqlite3_bind_text(stmt, 3, result->detections[i].label, -1, SQLITE_STATIC);
-        sqlite3_bind_double(stmt, 4, result->detections[i].confidence);
-        sqlite3_bind_double(stmt, 5, result->detections[i].x);
-        sqlite3_bind_double(stmt, 6, result->detections[i].y);
-        sqlite3_bind_double(stmt, 7, result->detections[i].width);
-        sqlite3_bind_double(stmt, 8, result->detections[i].height);
-        
-        // Execute statement
-        rc = sqlite3_step(stmt);
-        if (rc != SQLITE_DONE) {
+
+    // Rows are the default, and take what the compact blocks could not encode
+    sqlite3_stmt *insert_stmt = NULL;
+    int insert_day = -1;
+    for (int i = 0; i < count; i++) {
+        if (stored[i]) {
+            continue;
+        }
+
+        // A batch spans a day boundary at most once, so the statement is
+        // prepared again only then
+        int day = g_config.db_partition_by_day ? partition_day(rows[i].timestamp) : -1;
+        if (!insert_stmt || day != insert_day) {
+            insert_stmt = prepare_detection_insert(day);
+            insert_day = day;
+        }
+        if (!insert_stmt || insert_detection_row(insert_stmt, &rows[i]) != 0) {
             log_error("Failed to insert detection %d: %s", i, sqlite3_errmsg(db));
-            sqlite3_finalize(stmt);
             sqlite3_exec(db, "ROLLBACK;", NULL, NULL, NULL);
             pthread_mutex_unlock(db_mutex);
             return -1;
         }
-        
-        // Reset statement and clear bindings for next detection
-        sqlite3_reset(stmt);
-        sqlite3_clear_bindings(stmt);
     }
-    
-    // Untrack and finalize the prepared statement
-    sqlite3_finalize(stmt);
-    
-    // Commit transaction
+
+    // Kept with the rows, so timelines never show activity that was rolled back
+    if (store_detection_activity(db, rows, count) != 0) {
+        sqlite3_exec(db, "ROLLBACK;", NULL, NULL, NULL);
+        pthread_mutex_unlock(db_mutex);
+        return -1;
+    }
+
     rc = sqlite3_exec(db, "COMMIT;", NULL, NULL, &err_msg);
     if (rc != SQLITE_OK) {
         log_error("Failed to commit transaction: %s", err_msg);
@@ -177,29 +307,382 @@ int store_detections_in_db(const char *stream_name, const detection_result_t *re
         pthread_mutex_unlock(db_mutex);
         return -1;
     }
-    
-    // Verify the detections were stored
-    char verify_sql[256];
-    snprintf(verify_sql, sizeof(verify_sql), 
-            "SELECT COUNT(*) FROM detections WHERE stream_name = '%s' AND timestamp = %lld;",
-            stream_name, (long long)timestamp);
-    
-    rc = sqlite3_get_table(db, verify_sql, &query_result, &rows, &cols, &err_msg);
-    if (rc != SQLITE_OK) {
-        log_error("Failed to verify detections were stored: %s", err_msg);
-        sqlite3_free(err_msg);
-    } else if (rows > 0 && cols > 0) {
-        int count = atoi(query_result[1]); // First row, first column
-        log_info("Verified %d detections were stored in database for stream %s", count, stream_name);
-        sqlite3_free_table(query_result);
-    }
-    
+
     pthread_mutex_unlock(db_mutex);
+    return 0;
+}
+
+/**
+ * Move up to DETECTION_BATCH_ROWS rows from the queue into the writer's batch
+ * Must be called with the queue mutex held.
+ */
+static int take_detection_batch(void) {
+    int count = queue_count < DETECTION_BATCH_ROWS ? queue_count : DETECTION_BATCH_ROWS;
+    for (int i = 0; i < count; i++) {
+        writer_batch[i] = detection_queue[(queue_head + i) % DETECTION_QUEUE_SIZE];
+    }
+    queue_head = (queue_head + count) % DETECTION_QUEUE_SIZE;
+    queue_count -= count;
+    return count;
+}
+
+/**
+ * Record the db_commit pipeline stage of the frames of committed rows
+ * Rows of one frame are queued together and count once.
+ */
+static void trace_committed_rows(const queued_detection_t *rows, int count) {
+    for (int i = 0; i < count; i++) {
+        if (rows[i].trace.recv_us == 0) {
+            continue;
+        }
+        if (i > 0 && rows[i - 1].trace.recv_us == rows[i].trace.recv_us &&
+            strcmp(rows[i - 1].stream_name, rows[i].stream_name) == 0) {
+            continue;
+        }
+        pipeline_trace_stage(pipeline_trace_metric(rows[i].stream_name, PIPELINE_STAGE_DB_COMMIT), &rows[i].trace);
+    }
+}
+
+/**
+ * Writer thread
+ * Group-commits whatever all streams queued during the last batch window.
+ */
+static void *detection_writer_func(void *arg) {
+    (void)arg;
+    pthread_setname_np(pthread_self(), "db-detections");
+
+    pthread_mutex_lock(&queue_mutex);
+    while (writer_running || queue_count > 0) {
+        if (writer_running && queue_count < DETECTION_BATCH_ROWS) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += (long)DETECTION_BATCH_MS * 1000000L;
+            deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+            deadline.tv_nsec %= 1000000000L;
+            pthread_cond_timedwait(&queue_cond, &queue_mutex, &deadline);
+        }
+
+        if (dropped_detections > 0) {
+            log_warn("Detection write queue was full, dropped %lu detections", dropped_detections);
+            dropped_detections = 0;
+        }
+
+        int count = take_detection_batch();
+        if (count == 0) {
+            continue;
+        }
+        pthread_mutex_unlock(&queue_mutex);
+
+        // Detection threads keep queueing while the batch waits for the database
+        bool written = write_detection_batch(writer_batch, count) == 0;
+        if (written) {
+            trace_committed_rows(writer_batch, count);
+            log_debug("Stored a batch of %d detections", count);
+        } else {
+            log_error("Failed to store a batch of %d detections", count);
+        }
+
+        pthread_mutex_lock(&queue_mutex);
+        if (written) {
+            written_total += count;
+        }
+    }
+    pthread_mutex_unlock(&queue_mutex);
+
+    return NULL;
+}
+
+int init_detection_writer(void) {
+    pthread_mutex_lock(&queue_mutex);
+    if (writer_running) {
+        pthread_mutex_unlock(&queue_mutex);
+        return 0;
+    }
+
+    queue_head = 0;
+    queue_count = 0;
+    dropped_detections = 0;
+    writer_running = true;
+
+    if (pthread_create(&writer_thread, NULL, detection_writer_func, NULL) != 0) {
+        log_error("Failed to start detection writer thread");
+        writer_running = false;
+        pthread_mutex_unlock(&queue_mutex);
+        return -1;
+    }
+    pthread_mutex_unlock(&queue_mutex);
+
+    log_info("Detection writer started (batches of up to %d rows every %d ms)",
+             DETECTION_BATCH_ROWS, DETECTION_BATCH_MS);
+    return 0;
+}
+
+void shutdown_detection_writer(void) {
+    pthread_mutex_lock(&queue_mutex);
+    if (!writer_running) {
+        pthread_mutex_unlock(&queue_mutex);
+        return;
+    }
+    writer_running = false;
+    pthread_cond_signal(&queue_cond);
+    pthread_mutex_unlock(&queue_mutex);
+
+    // The thread stores what is still queued before it exits
+    pthread_join(writer_thread, NULL);
+
+    reset_detection_labels();
+    reset_partition_cache();
+
+    log_info("Detection writer stopped");
+}
+
+/**
+ * Store detection results in the database
+ * 
+ * @param stream_name Stream name
+ * @param result Detection results
+ * @param timestamp Timestamp of the detection (0 for current time)
+ * @return 0 on success, non-zero on failure
+ */
+int store_detections_in_db(const char *stream_name, const detection_result_t *result, time_t timestamp) {
+    if (!stream_name || !result) {
+        log_error("Invalid parameters for store_detections_in_db: stream_name=%p, result=%p", 
+                 stream_name, result);
+        return -1;
+    }
     
-    log_info("Successfully stored %d detections in database for stream %s", result->count, stream_name);
+    // Use current time if timestamp is 0
+    if (timestamp == 0) {
+        timestamp = time(NULL);
+    }
+
+    if (result->count <= 0) {
+        return 0;
+    }
+
+    log_debug("Queueing %d detections for stream %s, first: %s (%.2f%%)",
+              result->count, stream_name, result->detections[0].label,
+              result->detections[0].confidence * 100.0f);
+
+    pipeline_trace_t trace;
+    pipeline_trace_get_current(&trace);
+
+    pthread_mutex_lock(&queue_mutex);
+
+    // Without the writer thread (tools, tests, shutdown), write directly
+    if (!writer_running) {
+        pthread_mutex_unlock(&queue_mutex);
+
+        queued_detection_t rows[MAX_DETECTIONS];
+        int count = result->count < MAX_DETECTIONS ? result->count : MAX_DETECTIONS;
+        for (int i = 0; i < count; i++) {
+            snprintf(rows[i].stream_name, sizeof(rows[i].stream_name), "%s", stream_name);
+            rows[i].timestamp = timestamp;
+            rows[i].detection = result->detections[i];
+            rows[i].trace = trace;
+        }
+        if (write_detection_batch(rows, count) != 0) {
+            return -1;
+        }
+        trace_committed_rows(rows, count);
+
+        pthread_mutex_lock(&queue_mutex);
+        written_total += count;
+        pthread_mutex_unlock(&queue_mutex);
+        return 0;
+    }
+
+    for (int i = 0; i < result->count && i < MAX_DETECTIONS; i++) {
+        if (queue_count >= DETECTION_QUEUE_SIZE) {
+            dropped_detections += result->count - i;
+            dropped_total += result->count - i;
+            break;
+        }
+        queued_detection_t *row = &detection_queue[(queue_head + queue_count) % DETECTION_QUEUE_SIZE];
+        snprintf(row->stream_name, sizeof(row->stream_name), "%s", stream_name);
+        row->timestamp = timestamp;
+        row->detection = result->detections[i];
+        row->trace = trace;
+        queue_count++;
+    }
+
+    // A full batch is written right away rather than at the end of the window
+    if (queue_count >= DETECTION_BATCH_ROWS) {
+        pthread_cond_signal(&queue_cond);
+    }
+    pthread_mutex_unlock(&queue_mutex);
+
     return 0;
 }
 
+void get_detection_writer_stats(uint64_t *written, uint64_t *dropped) {
+    pthread_mutex_lock(&queue_mutex);
+    if (written) {
+        *written = written_total;
+    }
+    if (dropped) {
+        *dropped = dropped_total;
+    }
+    pthread_mutex_unlock(&queue_mutex);
+}
+
+/**
+ * Read detection rows selected as timestamp, label, confidence, x, y, width,
+ * height, track_id
+ *
+ * @return Number of rows read
+ */
+static int read_detection_rows(sqlite3_stmt *stmt, detection_t *detections, time_t *timestamps, int max_count) {
+    int count = 0;
+    while (count < max_count && sqlite3_step(stmt) == SQLITE_ROW) {
+        detection_t *d = &detections[count];
+        const char *label = (const char *)sqlite3_column_text(stmt, 1);
+        timestamps[count] = (time_t)sqlite3_column_int64(stmt, 0);
+        strncpy(d->label, label ? label : "unknown", MAX_LABEL_LENGTH - 1);
+        d->label[MAX_LABEL_LENGTH - 1] = '\0';
+        d->confidence = (float)sqlite3_column_double(stmt, 2);
+        d->x = (float)sqlite3_column_double(stmt, 3);
+        d->y = (float)sqlite3_column_double(stmt, 4);
+        d->width = (float)sqlite3_column_double(stmt, 5);
+        d->height = (float)sqlite3_column_double(stmt, 6);
+        d->track_id = sqlite3_column_int(stmt, 7);
+        count++;
+    }
+    return count;
+}
+
+/**
+ * Merge two lists of detections that are both newest first
+ *
+ * @return Number of detections written to out
+ */
+static int merge_newest_first(const detection_t *a, const time_t *a_ts, int a_count,
+                              const detection_t *b, const time_t *b_ts, int b_count,
+                              detection_t *out, time_t *out_ts, int max_count) {
+    int count = 0, i = 0, j = 0;
+    while (count < max_count && (i < a_count || j < b_count)) {
+        if (j >= b_count || (i < a_count && a_ts[i] >= b_ts[j])) {
+            out[count] = a[i];
+            out_ts[count] = a_ts[i++];
+        } else {
+            out[count] = b[j];
+            out_ts[count] = b_ts[j++];
+        }
+        count++;
+    }
+    return count;
+}
+
+/**
+ * Read the newest detections of a stream from the day partitions in a time range
+ * The partitions hold disjoint days, so reading them newest first gives
+ * the rows newest first.
+ *
+ * @return Number of detections, newest first
+ */
+static int collect_partition_detections(sqlite3 *db, const char *stream_name, sqlite3_int64 start_time,
+                                        sqlite3_int64 end_time, detection_t *detections, time_t *timestamps,
+                                        int max_count) {
+    int days[MAX_QUERY_PARTITIONS];
+    int last_day = end_time >= INT32_MAX * (sqlite3_int64)86400 ? INT32_MAX : partition_day((time_t)end_time);
+    int partitions = list_partitions(db, "detections", partition_day((time_t)start_time), last_day,
+                                     days, MAX_QUERY_PARTITIONS);
+
+    int count = 0;
+    for (int p = 0; p < partitions && count < max_count; p++) {
+        char name[MAX_PARTITION_NAME];
+        partition_name("detections", days[p], name, sizeof(name));
+
+        char sql[320];
+        snprintf(sql, sizeof(sql),
+                 "SELECT timestamp, label, confidence, x, y, width, height, track_id "
+                 "FROM \"%s\" "
+                 "WHERE stream_name = ? AND timestamp >= ? AND timestamp <= ? "
+                 "ORDER BY timestamp DESC "
+                 "LIMIT ?;", name);
+
+        sqlite3_stmt *stmt;
+        if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+            log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+            continue;
+        }
+        sqlite3_bind_text(stmt, 1, stream_name, -1, SQLITE_STATIC);
+        sqlite3_bind_int64(stmt, 2, start_time);
+        sqlite3_bind_int64(stmt, 3, end_time);
+        sqlite3_bind_int(stmt, 4, max_count - count);
+
+        count += read_detection_rows(stmt, detections + count, timestamps + count, max_count - count);
+        sqlite3_finalize(stmt);
+    }
+    return count;
+}
+
+/**
+ * Collect the newest detections of a stream in a time range
+ * Merges rows, day partitions and compact blocks, so detections stored
+ * before or after switching [database] compact_detections or
+ * partition_by_day are all found.
+ *
+ * @param db Connection from acquire_db_reader()
+ *
+ * @param start_time Oldest time to include (0 for no limit)
+ * @param end_time Newest time to include (0 for no limit)
+ * @return Number of detections, newest first, or -1 on error
+ */
+static int collect_detections(sqlite3 *db, const char *stream_name, time_t start_time, time_t end_time,
+                              detection_t *detections, time_t *timestamps, int max_count) {
+    sqlite3_stmt *stmt;
+    const char *sql = "SELECT timestamp, label, confidence, x, y, width, height, track_id "
+                      "FROM detections "
+                      "WHERE stream_id = " STREAM_ID_OF("?") " AND timestamp >= ? AND timestamp <= ? "
+                      "ORDER BY timestamp DESC "
+                      "LIMIT ?;";
+
+    if (max_count > MAX_DETECTIONS) {
+        max_count = MAX_DETECTIONS;
+    }
+    sqlite3_int64 start = start_time > 0 ? (sqlite3_int64)start_time : 0;
+    sqlite3_int64 end = end_time > 0 ? (sqlite3_int64)end_time : INT64_MAX;
+
+    stmt = get_reader_cached_stmt(db, DB_STMT_DETECTION_RANGE, sql);
+    if (!stmt) {
+        return -1;
+    }
+
+    sqlite3_bind_text(stmt, 1, stream_name, -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 2, start);
+    sqlite3_bind_int64(stmt, 3, end);
+    sqlite3_bind_int(stmt, 4, max_count);
+
+    detection_t table_detections[MAX_DETECTIONS];
+    time_t table_timestamps[MAX_DETECTIONS];
+    int table_count = read_detection_rows(stmt, table_detections, table_timestamps, max_count);
+    release_cached_stmt(stmt);
+
+    detection_t partition_detections[MAX_DETECTIONS];
+    time_t partition_timestamps[MAX_DETECTIONS];
+    int partition_count = collect_partition_detections(db, stream_name, start, end, partition_detections,
+                                                       partition_timestamps, max_count);
+
+    detection_t row_detections[MAX_DETECTIONS];
+    time_t row_timestamps[MAX_DETECTIONS];
+    int row_count = merge_newest_first(partition_detections, partition_timestamps, partition_count,
+                                       table_detections, table_timestamps, table_count,
+                                       row_detections, row_timestamps, max_count);
+
+    detection_t block_detections[MAX_DETECTIONS];
+    time_t block_timestamps[MAX_DETECTIONS];
+    int block_count = load_detection_blocks(db, stream_name, start_time, end_time, block_detections,
+                                            block_timestamps, max_count);
+    if (block_count < 0) {
+        block_count = 0;
+    }
+
+    return merge_newest_first(row_detections, row_timestamps, row_count,
+                              block_detections, block_timestamps, block_count,
+                              detections, timestamps, max_count);
+}
+
 /**
  * Get detection results from the database
  * 
@@ -212,11 +695,7 @@ int store_detections_in_db(const char *stream_name, const detection_result_t *re
  */
 int get_detections_from_db_time_range(const char *stream_name, detection_result_t *result, 
                                      uint64_t max_age, time_t start_time, time_t end_time) {
-    int rc;
-    sqlite3_stmt *stmt;
-    
     sqlite3 *db = get_db_handle();
-    pthread_mutex_t *db_mutex = get_db_mutex();
     
     if (!db) {
         log_error("Database not initialized");
@@ -230,195 +709,40 @@ int get_detections_from_db_time_range(const char *stream_name, detection_result_
     
     // Initialize result
     memset(result, 0, sizeof(detection_result_t));
-    
-    pthread_mutex_lock(db_mutex);
-    
-    // Build query based on filters
-    char sql[512];
-    
-    if (start_time > 0 && end_time > 0) {
-        // Time range filter
-        log_info("Getting detections for stream %s between %lld and %lld", 
-                stream_name, (long long)start_time, (long long)end_time);
-        
-        snprintf(sql, sizeof(sql), 
-                "SELECT label, confidence, x, y, width, height "
-                "FROM detections "
-                "WHERE stream_name = ? AND timestamp >= ? AND timestamp <= ? "
-                "ORDER BY timestamp DESC "
-                "LIMIT ?;");
-        
-        rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
-        if (rc != SQLITE_OK) {
-            log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
-            pthread_mutex_unlock(db_mutex);
-            return -1;
-        }
-        
-        // Bind parameters
-        sqlite3_bind_text(stmt, 1, stream_name, -1, SQLITE_STATIC);
-        sqlite3_bind_int64(stmt, 2, (sqlite3_int64)start_time);
-        sqlite3_bind_int64(stmt, 3, (sqlite3_int64)end_time);
-        sqlite3_bind_int(stmt, 4, MAX_DETECTIONS);
-    } else if (start_time > 0) {
-        // Start time filter only
-        log_info("Getting detections for stream %s from %lld", 
-                stream_name, (long long)start_time);
-        
-        snprintf(sql, sizeof(sql), 
-                "SELECT label, confidence, x, y, width, height "
-                "FROM detections "
-                "WHERE stream_name = ? AND timestamp >= ? "
-                "ORDER BY timestamp DESC "
-                "LIMIT ?;");
-        
-        rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
-        if (rc != SQLITE_OK) {
-            log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
-            pthread_mutex_unlock(db_mutex);
-            return -1;
-        }
-        
-        // Bind parameters
-        sqlite3_bind_text(stmt, 1, stream_name, -1, SQLITE_STATIC);
-        sqlite3_bind_int64(stmt, 2, (sqlite3_int64)start_time);
-        sqlite3_bind_int(stmt, 3, MAX_DETECTIONS);
-    } else if (end_time > 0) {
-        // End time filter only
-        log_info("Getting detections for stream %s until %lld", 
-                stream_name, (long long)end_time);
-        
-        snprintf(sql, sizeof(sql), 
-                "SELECT label, confidence, x, y, width, height "
-                "FROM detections "
-                "WHERE stream_name = ? AND timestamp <= ? "
-                "ORDER BY timestamp DESC "
-                "LIMIT ?;");
-        
-        rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
-        if (rc != SQLITE_OK) {
-            log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
-            pthread_mutex_unlock(db_mutex);
-            return -1;
-        }
-        
-        // Bind parameters
-        sqlite3_bind_text(stmt, 1, stream_name, -1, SQLITE_STATIC);
-        sqlite3_bind_int64(stmt, 2, (sqlite3_int64)end_time);
-        sqlite3_bind_int(stmt, 3, MAX_DETECTIONS);
-    } else if (max_age > 0) {
-        // Max age filter
-        // Calculate cutoff time
-        time_t cutoff_time = time(NULL) - max_age;
-        
-        log_info("Getting detections for stream %s since %lld (max age %llu seconds)", 
-                stream_name, (long long)cutoff_time, (unsigned long long)max_age);
-        
-        // First get the latest timestamp
-        snprintf(sql, sizeof(sql), 
-                "SELECT MAX(timestamp) "
-                "FROM detections "
-                "WHERE stream_name = ? AND timestamp >= ?;");
-        
-        rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
-        if (rc != SQLITE_OK) {
-            log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
-            pthread_mutex_unlock(db_mutex);
-            return -1;
-        }
-        
-        // Bind parameters
-        sqlite3_bind_text(stmt, 1, stream_name, -1, SQLITE_STATIC);
-        sqlite3_bind_int64(stmt, 2, (sqlite3_int64)cutoff_time);
-        
-        // Execute query to get latest timestamp
-        time_t latest_timestamp = 0;
-        if (sqlite3_step(stmt) == SQLITE_ROW) {
-            latest_timestamp = (time_t)sqlite3_column_int64(stmt, 0);
-        }
 
-        sqlite3_finalize(stmt);
-        
-        // If no timestamp found, return empty result
-        if (latest_timestamp == 0) {
-            pthread_mutex_unlock(db_mutex);
-            log_info("No recent detections found for stream %s", stream_name);
-            return 0;
-        }
-        
-        // Now get all detections at that timestamp
-        snprintf(sql, sizeof(sql), 
-                "SELECT label, confidence, x, y, width, height "
-                "FROM detections "
-                "WHERE stream_name = ? AND timestamp = ? "
-                "LIMIT ?;");
-        
-        rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
-        if (rc != SQLITE_OK) {
-            log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
-            pthread_mutex_unlock(db_mutex);
-            return -1;
-        }
-        
-        // Bind parameters
-        sqlite3_bind_text(stmt, 1, stream_name, -1, SQLITE_STATIC);
-        sqlite3_bind_int64(stmt, 2, (sqlite3_int64)latest_timestamp);
-        sqlite3_bind_int(stmt, 3, MAX_DETECTIONS);
-    } else {
-        // No filters, just get the latest detections
-        log_info("Getting latest detections for stream %s (no time filters)", stream_name);
-        
-        snprintf(sql, sizeof(sql), 
-                "SELECT label, confidence, x, y, width, height "
-                "FROM detections "
-                "WHERE stream_name = ? "
-                "ORDER BY timestamp DESC "
-                "LIMIT ?;");
-        
-        rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
-        if (rc != SQLITE_OK) {
-            log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
-            pthread_mutex_unlock(db_mutex);
-            return -1;
-        }
-        
-        // Bind parameters
-        sqlite3_bind_text(stmt, 1, stream_name, -1, SQLITE_STATIC);
-        sqlite3_bind_int(stmt, 2, MAX_DETECTIONS);
+    // Without a time range, max_age asks for the detections of the latest frame within it
+    bool latest_only = false;
+    if (start_time <= 0 && end_time <= 0 && max_age > 0) {
+        start_time = time(NULL) - max_age;
+        latest_only = true;
     }
-    
-    // Execute query and fetch results
-    int count = 0;
-    while (sqlite3_step(stmt) == SQLITE_ROW && count < MAX_DETECTIONS) {
-        // Get detection data
-        const char *label = (const char *)sqlite3_column_text(stmt, 0);
-        float confidence = (float)sqlite3_column_double(stmt, 1);
-        float x = (float)sqlite3_column_double(stmt, 2);
-        float y = (float)sqlite3_column_double(stmt, 3);
-        float width = (float)sqlite3_column_double(stmt, 4);
-        float height = (float)sqlite3_column_double(stmt, 5);
-        
-        // Store in result
-        if (label) {
-            strncpy(result->detections[count].label, label, MAX_LABEL_LENGTH - 1);
-            result->detections[count].label[MAX_LABEL_LENGTH - 1] = '\0';
-        } else {
-            strncpy(result->detections[count].label, "unknown", MAX_LABEL_LENGTH - 1);
+
+    log_info("Getting detections for stream %s between %lld and %lld%s",
+            stream_name, (long long)start_time, (long long)end_time,
+            latest_only ? " (latest only)" : "");
+
+    time_t timestamps[MAX_DETECTIONS];
+    db = acquire_db_reader();
+    if (!db) {
+        return -1;
+    }
+    int count = collect_detections(db, stream_name, start_time, end_time,
+                                   result->detections, timestamps, MAX_DETECTIONS);
+    release_db_reader(db);
+
+    if (count < 0) {
+        return -1;
+    }
+
+    if (latest_only) {
+        int latest = 0;
+        while (latest < count && timestamps[latest] == timestamps[0]) {
+            latest++;
         }
-        
-        result->detections[count].confidence = confidence;
-        result->detections[count].x = x;
-        result->detections[count].y = y;
-        result->detections[count].width = width;
-        result->detections[count].height = height;
-        
-        count++;
+        count = latest;
     }
     
     result->count = count;
-
-    sqlite3_finalize(stmt);
-    pthread_mutex_unlock(db_mutex);
     
     log_info("Found %d detections in database for stream %s", count, stream_name);
     return count;
@@ -437,11 +761,7 @@ int get_detections_from_db_time_range(const char *stream_name, detection_result_
  */
 int get_detection_timestamps(const char *stream_name, detection_result_t *result, time_t *timestamps,
                            uint64_t max_age, time_t start_time, time_t end_time) {
-    int rc;
-    sqlite3_stmt *stmt;
-    
     sqlite3 *db = get_db_handle();
-    pthread_mutex_t *db_mutex = get_db_mutex();
     
     if (!db) {
         log_error("Database not initialized");
@@ -452,152 +772,40 @@ int get_detection_timestamps(const char *stream_name, detection_result_t *result
         log_error("Invalid parameters for get_detection_timestamps");
         return -1;
     }
-    
-    pthread_mutex_lock(db_mutex);
-    
-    // Build query based on filters
-    char sql[512];
-    
-    if (start_time > 0 && end_time > 0) {
-        // Time range filter
-        snprintf(sql, sizeof(sql), 
-                "SELECT timestamp, label, confidence, x, y, width, height "
-                "FROM detections "
-                "WHERE stream_name = ? AND timestamp >= ? AND timestamp <= ? "
-                "ORDER BY timestamp DESC "
-                "LIMIT ?;");
-        
-        rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
-        if (rc != SQLITE_OK) {
-            log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
-            pthread_mutex_unlock(db_mutex);
-            return -1;
-        }
 
-        // Bind parameters
-        sqlite3_bind_text(stmt, 1, stream_name, -1, SQLITE_STATIC);
-        sqlite3_bind_int64(stmt, 2, (sqlite3_int64)start_time);
-        sqlite3_bind_int64(stmt, 3, (sqlite3_int64)end_time);
-        sqlite3_bind_int(stmt, 4, MAX_DETECTIONS);
-    } else if (start_time > 0) {
-        // Start time filter only
-        snprintf(sql, sizeof(sql), 
-                "SELECT timestamp, label, confidence, x, y, width, height "
-                "FROM detections "
-                "WHERE stream_name = ? AND timestamp >= ? "
-                "ORDER BY timestamp DESC "
-                "LIMIT ?;");
-        
-        rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
-        if (rc != SQLITE_OK) {
-            log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
-            pthread_mutex_unlock(db_mutex);
-            return -1;
-        }
-        
-        // Bind parameters
-        sqlite3_bind_text(stmt, 1, stream_name, -1, SQLITE_STATIC);
-        sqlite3_bind_int64(stmt, 2, (sqlite3_int64)start_time);
-        sqlite3_bind_int(stmt, 3, MAX_DETECTIONS);
-    } else if (end_time > 0) {
-        // End time filter only
-        snprintf(sql, sizeof(sql), 
-                "SELECT timestamp, label, confidence, x, y, width, height "
-                "FROM detections "
-                "WHERE stream_name = ? AND timestamp <= ? "
-                "ORDER BY timestamp DESC "
-                "LIMIT ?;");
-        
-        rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
-        if (rc != SQLITE_OK) {
-            log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
-            pthread_mutex_unlock(db_mutex);
-            return -1;
-        }
-        
-        // Bind parameters
-        sqlite3_bind_text(stmt, 1, stream_name, -1, SQLITE_STATIC);
-        sqlite3_bind_int64(stmt, 2, (sqlite3_int64)end_time);
-        sqlite3_bind_int(stmt, 3, MAX_DETECTIONS);
-    } else if (max_age > 0) {
-        // Max age filter
-        // Calculate cutoff time
-        time_t cutoff_time = time(NULL) - max_age;
-        
-        // First get the latest timestamp
-        snprintf(sql, sizeof(sql), 
-                "SELECT timestamp, label, confidence, x, y, width, height "
-                "FROM detections "
-                "WHERE stream_name = ? AND timestamp >= ? "
-                "ORDER BY timestamp DESC "
-                "LIMIT ?;");
-        
-        rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
-        if (rc != SQLITE_OK) {
-            log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
-            pthread_mutex_unlock(db_mutex);
-            return -1;
-        }
-        
-        // Bind parameters
-        sqlite3_bind_text(stmt, 1, stream_name, -1, SQLITE_STATIC);
-        sqlite3_bind_int64(stmt, 2, (sqlite3_int64)cutoff_time);
-        sqlite3_bind_int(stmt, 3, MAX_DETECTIONS);
-    } else {
-        // No filters, just get the latest detections
-        snprintf(sql, sizeof(sql), 
-                "SELECT timestamp, label, confidence, x, y, width, height "
-                "FROM detections "
-                "WHERE stream_name = ? "
-                "ORDER BY timestamp DESC "
-                "LIMIT ?;");
-        
-        rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
-        if (rc != SQLITE_OK) {
-            log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
-            pthread_mutex_unlock(db_mutex);
-            return -1;
-        }
-        
-        // Bind parameters
-        sqlite3_bind_text(stmt, 1, stream_name, -1, SQLITE_STATIC);
-        sqlite3_bind_int(stmt, 2, MAX_DETECTIONS);
+    if (start_time <= 0 && end_time <= 0 && max_age > 0) {
+        start_time = time(NULL) - max_age;
     }
-    
-    // Execute query and fetch results
-    int count = 0;
-    while (sqlite3_step(stmt) == SQLITE_ROW && count < result->count) {
-        // Get timestamp
-        timestamps[count] = (time_t)sqlite3_column_int64(stmt, 0);
-        
-        // Get detection data to match with result
-        const char *label = (const char *)sqlite3_column_text(stmt, 1);
-        float confidence = (float)sqlite3_column_double(stmt, 2);
-        float x = (float)sqlite3_column_double(stmt, 3);
-        float y = (float)sqlite3_column_double(stmt, 4);
-        float width = (float)sqlite3_column_double(stmt, 5);
-        float height = (float)sqlite3_column_double(stmt, 6);
-        
-        // Find matching detection in result
+
+    detection_t found[MAX_DETECTIONS];
+    time_t found_timestamps[MAX_DETECTIONS];
+    db = acquire_db_reader();
+    if (!db) {
+        return -1;
+    }
+    int count = collect_detections(db, stream_name, start_time, end_time,
+                                   found, found_timestamps, MAX_DETECTIONS);
+    release_db_reader(db);
+
+    if (count < 0) {
+        return -1;
+    }
+
+    // Find the stored detection each result came from
+    for (int n = 0; n < count; n++) {
         for (int i = 0; i < result->count; i++) {
-            if (strcmp(result->detections[i].label, label) == 0 &&
-                fabs(result->detections[i].confidence - confidence) < 0.001 &&
-                fabs(result->detections[i].x - x) < 0.001 &&
-                fabs(result->detections[i].y - y) < 0.001 &&
-                fabs(result->detections[i].width - width) < 0.001 &&
-                fabs(result->detections[i].height - height) < 0.001) {
-                // Found matching detection, store timestamp
-                timestamps[i] = timestamps[count];
+            if (strcmp(result->detections[i].label, found[n].label) == 0 &&
+                fabs(result->detections[i].confidence - found[n].confidence) < 0.001 &&
+                fabs(result->detections[i].x - found[n].x) < 0.001 &&
+                fabs(result->detections[i].y - found[n].y) < 0.001 &&
+                fabs(result->detections[i].width - found[n].width) < 0.001 &&
+                fabs(result->detections[i].height - found[n].height) < 0.001) {
+                timestamps[i] = found_timestamps[n];
                 break;
             }
         }
-        
-        count++;
     }
     
-    sqlite3_finalize(stmt);
-    pthread_mutex_unlock(db_mutex);
-    
     return 0;
 }
 
@@ -621,10 +829,6 @@ int get_detections_from_db(const char *stream_name, detection_result_t *result,
  * @return Number of detections deleted, or -1 on error
  */
 int delete_old_detections(uint64_t max_age) {
-    int rc;
-    sqlite3_stmt *stmt;
-    int deleted_count = 0;
-    
     sqlite3 *db = get_db_handle();
     pthread_mutex_t *db_mutex = get_db_mutex();
     
@@ -633,38 +837,95 @@ int delete_old_detections(uint64_t max_age) {
         return -1;
     }
     
-    pthread_mutex_lock(db_mutex);
+    // Calculate cutoff time
+    time_t cutoff_time = time(NULL) - max_age;
     
-    const char *sql = "DELETE FROM detections WHERE timestamp < ?;";
+    const char *sql = "DELETE FROM detections WHERE id IN "
+                      "(SELECT id FROM detections WHERE timestamp < ? LIMIT ?);";
+    
+    int deleted_count = delete_rows_in_batches(sql, cutoff_time);
+    if (deleted_count < 0) {
+        log_error("Failed to delete old detections");
+        return -1;
+    }
+
+    // Compact storage drops whole minutes, one row per stream and minute,
+    // and partitions whole days, whatever the setting so none are left behind
+    lock_db_mutex();
+    int dropped = drop_partitions_before(db, "detections", partition_day(cutoff_time));
+    if (dropped > 0) {
+        log_info("Dropped %d expired detection partitions", dropped);
+    }
+    int deleted_blocks = delete_detection_blocks_before(db, cutoff_time);
+    if (deleted_blocks > 0) {
+        deleted_count += deleted_blocks;
+    }
+    delete_detection_activity_before(db, cutoff_time);
+    pthread_mutex_unlock(db_mutex);
     
+    log_info("Deleted %d old detections from database", deleted_count);
+    return deleted_count;
+}
+
+/**
+ * Get the highest track ID stored in the database
+ *
+ * @return Highest track ID among the latest detections, 0 if none, -1 on error
+ */
+int get_max_detection_track_id(void) {
+    int rc;
+    sqlite3_stmt *stmt;
+    int max_id = 0;
+
+    sqlite3 *db = get_db_handle();
+    pthread_mutex_t *db_mutex = get_db_mutex();
+
+    if (!db) {
+        log_error("Database not initialized");
+        return -1;
+    }
+
+    lock_db_mutex();
+
+    // Track IDs grow with the row IDs, so the latest rows hold the highest one
+    const char *sql = "SELECT MAX(track_id) FROM "
+                      "(SELECT track_id FROM detections ORDER BY id DESC LIMIT 1000);";
+
     rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
     if (rc != SQLITE_OK) {
         log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
         pthread_mutex_unlock(db_mutex);
         return -1;
     }
-    
-    // Calculate cutoff time
-    time_t cutoff_time = time(NULL) - max_age;
-    
-    // Bind parameters
-    sqlite3_bind_int64(stmt, 1, (sqlite3_int64)cutoff_time);
-    
-    // Execute statement
-    rc = sqlite3_step(stmt);
-    if (rc != SQLITE_DONE) {
-        log_error("Failed to delete old detections: %s", sqlite3_errmsg(db));
-        sqlite3_finalize(stmt);
-        pthread_mutex_unlock(db_mutex);
-        return -1;
+
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        max_id = sqlite3_column_int(stmt, 0);
     }
-    
-    deleted_count = sqlite3_changes(db);
-    
-    // finalize the prepared statement
+
     sqlite3_finalize(stmt);
+
+    // The newest partition holds the latest rows when partitioning is on
+    int days[1];
+    if (list_partitions(db, "detections", 0, INT32_MAX, days, 1) == 1) {
+        char name[MAX_PARTITION_NAME];
+        partition_name("detections", days[0], name, sizeof(name));
+
+        char partition_sql[192];
+        snprintf(partition_sql, sizeof(partition_sql),
+                 "SELECT MAX(track_id) FROM (SELECT track_id FROM \"%s\" ORDER BY id DESC LIMIT 1000);", name);
+        if (sqlite3_prepare_v2(db, partition_sql, -1, &stmt, NULL) == SQLITE_OK) {
+            if (sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_int(stmt, 0) > max_id) {
+                max_id = sqlite3_column_int(stmt, 0);
+            }
+            sqlite3_finalize(stmt);
+        }
+    }
+
+    int block_max_id = get_detection_blocks_max_track_id(db);
+    if (block_max_id > max_id) {
+        max_id = block_max_id;
+    }
     pthread_mutex_unlock(db_mutex);
-    
-    log_info("Deleted %d old detections from database", deleted_count);
-    return deleted_count;
+
+    return max_id;
 }
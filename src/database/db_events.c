@@ -5,17 +5,38 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include <time.h>
 #include <sqlite3.h>
 #include <stdbool.h>
 
 #include "database/db_events.h"
 #include "database/db_core.h"
+#include "database/db_maintenance.h"
+#include "database/db_partitions.h"
+#include "database/db_streams.h"
+#include "core/config.h"
 #include "core/logger.h"
 
+// Schema of the day partitions, see db_partitions.h
+#define EVENT_PARTITION_COLUMNS \
+    "id INTEGER PRIMARY KEY, type INTEGER NOT NULL, timestamp INTEGER NOT NULL, " \
+    "stream_name TEXT, description TEXT NOT NULL, details TEXT"
+#define EVENT_PARTITION_INDEX "timestamp"
+
+// Event IDs from a partition carry the day in their upper 32 bits, so they
+// stay unique across partitions and the events table
+#define EVENT_PARTITION_ID(day, rowid) (((uint64_t)(day) << 32) | (uint64_t)(rowid))
+
 // Add an event to the database
 uint64_t add_event(event_type_t type, const char *stream_name, 
                   const char *description, const char *details) {
+    return add_event_at(type, time(NULL), stream_name, description, details);
+}
+
+// Add an event that happened at a given time
+uint64_t add_event_at(event_type_t type, time_t timestamp, const char *stream_name,
+                      const char *description, const char *details) {
     int rc;
     sqlite3_stmt *stmt;
     uint64_t event_id = 0;
@@ -33,10 +54,23 @@ uint64_t add_event(event_type_t type, const char *stream_name,
         return 0;
     }
     
-    pthread_mutex_lock(db_mutex);
+    int day = g_config.db_partition_by_day ? partition_day(timestamp) : -1;
+    char table[MAX_PARTITION_NAME] = "events";
+    
+    lock_db_mutex();
+    
+    if (day >= 0) {
+        if (ensure_partition(db, "events", day, EVENT_PARTITION_COLUMNS, EVENT_PARTITION_INDEX) != 0) {
+            pthread_mutex_unlock(db_mutex);
+            return 0;
+        }
+        partition_name("events", day, table, sizeof(table));
+    }
     
-    const char *sql = "INSERT INTO events (type, timestamp, stream_name, description, details) "
-                      "VALUES (?, ?, ?, ?, ?);";
+    char sql[192];
+    snprintf(sql, sizeof(sql),
+             "INSERT INTO \"%s\" (type, timestamp, stream_name, description, details) "
+             "VALUES (?, ?, ?, ?, ?);", table);
     
     rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
     if (rc != SQLITE_OK) {
@@ -47,7 +81,7 @@ uint64_t add_event(event_type_t type, const char *stream_name,
     
     // Bind parameters
     sqlite3_bind_int(stmt, 1, (int)type);
-    sqlite3_bind_int64(stmt, 2, (sqlite3_int64)time(NULL));
+    sqlite3_bind_int64(stmt, 2, (sqlite3_int64)timestamp);
     
     if (stream_name) {
         sqlite3_bind_text(stmt, 3, stream_name, -1, SQLITE_STATIC);
@@ -69,6 +103,9 @@ uint64_t add_event(event_type_t type, const char *stream_name,
         log_error("Failed to add event: %s", sqlite3_errmsg(db));
     } else {
         event_id = (uint64_t)sqlite3_last_insert_rowid(db);
+        if (day >= 0) {
+            event_id = EVENT_PARTITION_ID(day, event_id);
+        }
         log_debug("Added event with ID %llu", (unsigned long long)event_id);
     }
     
@@ -87,7 +124,6 @@ int get_events(time_t start_time, time_t end_time, int type,
     int count = 0;
     
     sqlite3 *db = get_db_handle();
-    pthread_mutex_t *db_mutex = get_db_mutex();
     
     if (!db) {
         log_error("Database not initialized");
@@ -99,57 +135,87 @@ int get_events(time_t start_time, time_t end_time, int type,
         return -1;
     }
     
-    pthread_mutex_lock(db_mutex);
+    // Runs on a reader connection and never waits for the writer
+    db = acquire_db_reader();
+    if (!db) {
+        log_error("Database not initialized");
+        return -1;
+    }
     
-    // Build query based on filters
-    char sql[1024];
-    strcpy(sql, "SELECT id, type, timestamp, stream_name, description, details FROM events WHERE 1=1");
+    // Build the filter; parameters are numbered so every source can share them
+    char where[160] = "WHERE 1=1";
     
     if (start_time > 0) {
-        strcat(sql, " AND timestamp >= ?");
+        strcat(where, " AND timestamp >= ?1");
     }
     
     if (end_time > 0) {
-        strcat(sql, " AND timestamp <= ?");
+        strcat(where, " AND timestamp <= ?2");
     }
     
     if (type >= 0) {
-        strcat(sql, " AND type = ?");
+        strcat(where, " AND type = ?3");
     }
     
-    if (stream_name) {
-        strcat(sql, " AND stream_name = ?");
+    // The events table is indexed by stream ID, the partitions by name
+    char table_where[256];
+    char partition_where[192];
+    snprintf(table_where, sizeof(table_where), "%s%s", where,
+             stream_name ? " AND stream_id = " STREAM_ID_OF("?4") : "");
+    snprintf(partition_where, sizeof(partition_where), "%s%s", where,
+             stream_name ? " AND stream_name = ?4" : "");
+    
+    // Day partitions in range are read along with the events table
+    int days[MAX_QUERY_PARTITIONS];
+    int partitions = list_partitions(db, "events", partition_day(start_time),
+                                     end_time > 0 ? partition_day(end_time) : INT32_MAX,
+                                     days, MAX_QUERY_PARTITIONS);
+    
+    sqlite3_str *query = sqlite3_str_new(db);
+    sqlite3_str_appendf(query, "SELECT id, type, timestamp, stream_name, description, details "
+                               "FROM events %s", table_where);
+    for (int p = 0; p < partitions; p++) {
+        char name[MAX_PARTITION_NAME];
+        partition_name("events", days[p], name, sizeof(name));
+        sqlite3_str_appendf(query, " UNION ALL SELECT %lld | id, type, timestamp, stream_name, description, details "
+                                   "FROM \"%w\" %s",
+                            (long long)EVENT_PARTITION_ID(days[p], 0), name, partition_where);
     }
+    sqlite3_str_appendall(query, " ORDER BY timestamp DESC LIMIT ?5;");
     
-    strcat(sql, " ORDER BY timestamp DESC LIMIT ?;");
+    char *sql = sqlite3_str_finish(query);
+    if (!sql) {
+        log_error("Failed to build events query");
+        release_db_reader(db);
+        return -1;
+    }
     
     rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+    sqlite3_free(sql);
     if (rc != SQLITE_OK) {
         log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
-        pthread_mutex_unlock(db_mutex);
+        release_db_reader(db);
         return -1;
     }
     
     // Bind parameters
-    int param_index = 1;
-    
     if (start_time > 0) {
-        sqlite3_bind_int64(stmt, param_index++, (sqlite3_int64)start_time);
+        sqlite3_bind_int64(stmt, 1, (sqlite3_int64)start_time);
     }
     
     if (end_time > 0) {
-        sqlite3_bind_int64(stmt, param_index++, (sqlite3_int64)end_time);
+        sqlite3_bind_int64(stmt, 2, (sqlite3_int64)end_time);
     }
     
     if (type >= 0) {
-        sqlite3_bind_int(stmt, param_index++, type);
+        sqlite3_bind_int(stmt, 3, type);
     }
     
     if (stream_name) {
-        sqlite3_bind_text(stmt, param_index++, stream_name, -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 4, stream_name, -1, SQLITE_STATIC);
     }
     
-    sqlite3_bind_int(stmt, param_index, max_count);
+    sqlite3_bind_int(stmt, 5, max_count);
     
     // Execute query and fetch results
     while (sqlite3_step(stmt) == SQLITE_ROW && count < max_count) {
@@ -186,7 +252,7 @@ int get_events(time_t start_time, time_t end_time, int type,
     
     // finalize the prepared statement
     sqlite3_finalize(stmt);
-    pthread_mutex_unlock(db_mutex);
+    release_db_reader(db);
     
     log_info("Found %d events in database matching criteria", count);
     return count;
@@ -194,49 +260,29 @@ int get_events(time_t start_time, time_t end_time, int type,
 
 // Delete old events from the database
 int delete_old_events(uint64_t max_age) {
-    int rc;
-    sqlite3_stmt *stmt;
-    int deleted_count = 0;
-    
-    sqlite3 *db = get_db_handle();
-    pthread_mutex_t *db_mutex = get_db_mutex();
-    
-    if (!db) {
-        log_error("Database not initialized");
-        return -1;
-    }
-    
-    pthread_mutex_lock(db_mutex);
-    
-    const char *sql = "DELETE FROM events WHERE timestamp < ?;";
-    
-    rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
-        log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
-        pthread_mutex_unlock(db_mutex);
-        return -1;
-    }
-    
     // Calculate cutoff time
     time_t cutoff_time = time(NULL) - max_age;
     
-    // Bind parameters
-    sqlite3_bind_int64(stmt, 1, (sqlite3_int64)cutoff_time);
+    const char *sql = "DELETE FROM events WHERE id IN "
+                      "(SELECT id FROM events WHERE timestamp < ? LIMIT ?);";
     
-    // Execute statement
-    rc = sqlite3_step(stmt);
-    if (rc != SQLITE_DONE) {
-        log_error("Failed to delete old events: %s", sqlite3_errmsg(db));
-        sqlite3_finalize(stmt);
-        pthread_mutex_unlock(db_mutex);
+    int deleted_count = delete_rows_in_batches(sql, cutoff_time);
+    if (deleted_count < 0) {
+        log_error("Failed to delete old events");
         return -1;
     }
     
-    deleted_count = sqlite3_changes(db);
-    
-    // finalize the prepared statement
-    sqlite3_finalize(stmt);
-    pthread_mutex_unlock(db_mutex);
+    // Partitions go whole, whatever the setting so none are left behind
+    sqlite3 *db = get_db_handle();
+    pthread_mutex_t *db_mutex = get_db_mutex();
+    if (db) {
+        lock_db_mutex();
+        int dropped = drop_partitions_before(db, "events", partition_day(cutoff_time));
+        pthread_mutex_unlock(db_mutex);
+        if (dropped > 0) {
+            log_info("Dropped %d expired event partitions", dropped);
+        }
+    }
     
     return deleted_count;
 }
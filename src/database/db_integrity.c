@@ -0,0 +1,394 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sqlite3.h>
+
+#include "database/db_integrity.h"
+#include "database/db_core.h"
+#include "database/db_backup.h"
+#include "core/logger.h"
+
+// Length of the SQLite file header and the WAL header
+#define DB_HEADER_SIZE 100
+#define WAL_HEADER_SIZE 32
+
+// VM steps between two pauses of the full check
+#define INTEGRITY_PACE_STEPS 10000
+// Length of such a pause
+#define INTEGRITY_PACE_US 1000
+// Pause between two tables, which also lets WAL checkpoints catch up
+#define INTEGRITY_TABLE_PAUSE_MS 500
+
+static pthread_t check_thread;
+static bool check_started = false;
+static bool check_stopping = false;
+static sqlite3 *check_db = NULL;
+static char check_path[1024];
+static int check_delay_sec = 0;
+static db_integrity_status_t check_status;
+
+static pthread_mutex_t check_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t check_cond = PTHREAD_COND_INITIALIZER;
+
+static uint32_t read_be32(const unsigned char *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+// Check the WAL header; a damaged WAL is ignored by SQLite, so only warn
+static void check_wal_header(const char *db_path) {
+    char wal_path[1100];
+    snprintf(wal_path, sizeof(wal_path), "%s-wal", db_path);
+
+    FILE *f = fopen(wal_path, "rb");
+    if (!f) {
+        return;
+    }
+    unsigned char header[WAL_HEADER_SIZE];
+    size_t n = fread(header, 1, sizeof(header), f);
+    fclose(f);
+
+    // An empty WAL is what a clean shutdown leaves behind
+    if (n == 0) {
+        return;
+    }
+    uint32_t magic = n == sizeof(header) ? read_be32(header) : 0;
+    if ((magic != 0x377f0682 && magic != 0x377f0683) || read_be32(header + 4) != 3007000) {
+        log_warn("WAL file %s has no valid header, changes not yet checkpointed are lost", wal_path);
+    }
+}
+
+int database_fast_check(sqlite3 *conn, const char *db_path, char *msg, size_t size) {
+    unsigned char header[DB_HEADER_SIZE];
+    struct stat st;
+
+    FILE *f = fopen(db_path, "rb");
+    if (!f) {
+        snprintf(msg, size, "cannot open database file: %s", strerror(errno));
+        return -1;
+    }
+    size_t n = fread(header, 1, sizeof(header), f);
+    int fd_ok = fstat(fileno(f), &st) == 0;
+    fclose(f);
+
+    // A zero length file is a database SQLite has not written to yet
+    if (n == 0) {
+        return 0;
+    }
+    if (n < sizeof(header) || memcmp(header, "SQLite format 3", 16) != 0) {
+        snprintf(msg, size, "not an SQLite database file");
+        return -1;
+    }
+
+    uint32_t page_size = ((uint32_t)header[16] << 8) | header[17];
+    if (page_size == 1) {
+        page_size = 65536;
+    }
+    if (page_size < 512 || page_size > 65536 || (page_size & (page_size - 1)) != 0) {
+        snprintf(msg, size, "invalid page size %u in header", page_size);
+        return -1;
+    }
+    if (header[18] < 1 || header[18] > 2 || header[19] < 1 || header[19] > 2) {
+        snprintf(msg, size, "invalid file format %d/%d in header", header[18], header[19]);
+        return -1;
+    }
+
+    // The page count in the header is only valid if it was written together
+    // with the change counter; pages still in the WAL are not counted in it
+    uint32_t page_count = read_be32(header + 28);
+    if (fd_ok && read_be32(header + 92) == read_be32(header + 24) &&
+        (uint64_t)st.st_size < (uint64_t)page_count * page_size) {
+        snprintf(msg, size, "database file is truncated: %lld of %llu bytes",
+                 (long long)st.st_size, (unsigned long long)page_count * page_size);
+        return -1;
+    }
+
+    check_wal_header(db_path);
+
+    // Reading the schema parses page 1 and the WAL index
+    sqlite3_stmt *stmt = NULL;
+    int rc = sqlite3_prepare_v2(conn, "SELECT count(*) FROM sqlite_master;", -1, &stmt, NULL);
+    if (rc == SQLITE_OK) {
+        rc = sqlite3_step(stmt);
+    }
+    if (rc != SQLITE_ROW) {
+        snprintf(msg, size, "cannot read schema: %s", sqlite3_errmsg(conn));
+        sqlite3_finalize(stmt);
+        return -1;
+    }
+    sqlite3_finalize(stmt);
+    return 0;
+}
+
+// Pace the check and abort it on shutdown
+static int integrity_progress(void *arg) {
+    (void)arg;
+    if (__atomic_load_n(&check_stopping, __ATOMIC_RELAXED)) {
+        return 1;
+    }
+    usleep(INTEGRITY_PACE_US);
+    return 0;
+}
+
+// Wait on the check condition, returns true if the check is being stopped
+static bool wait_for_stop(int ms) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += ms / 1000;
+    deadline.tv_nsec += (long)(ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&check_mutex);
+    while (!check_stopping) {
+        if (pthread_cond_timedwait(&check_cond, &check_mutex, &deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+    bool stopping = check_stopping;
+    pthread_mutex_unlock(&check_mutex);
+    return stopping;
+}
+
+static void finish_check(db_integrity_state_t state, const char *message) {
+    pthread_mutex_lock(&check_mutex);
+    check_status.state = state;
+    check_status.finished_at = time(NULL);
+    if (message && check_status.message[0] == '\0') {
+        snprintf(check_status.message, sizeof(check_status.message), "%s", message);
+    }
+    pthread_mutex_unlock(&check_mutex);
+}
+
+// Collect the names of the tables to check, one integrity check each
+static int list_tables(sqlite3 *conn, char ***names) {
+    sqlite3_stmt *stmt = NULL;
+    int count = 0, capacity = 0;
+    *names = NULL;
+
+    if (sqlite3_prepare_v2(conn,
+            "SELECT name FROM sqlite_master WHERE type = 'table' "
+            "AND sql NOT LIKE 'CREATE VIRTUAL%' ORDER BY name;",
+            -1, &stmt, NULL) != SQLITE_OK) {
+        return -1;
+    }
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 32;
+            char **grown = realloc(*names, capacity * sizeof(char *));
+            if (!grown) {
+                break;
+            }
+            *names = grown;
+        }
+        char *name = strdup((const char *)sqlite3_column_text(stmt, 0));
+        if (!name) {
+            break;
+        }
+        (*names)[count++] = name;
+    }
+    sqlite3_finalize(stmt);
+    return count;
+}
+
+// Check one table and its indexes, returns the number of problems found
+static int check_table(sqlite3 *conn, const char *table, int *rc_out) {
+    int problems = 0;
+    char *sql = sqlite3_mprintf("PRAGMA integrity_check(\"%w\");", table);
+    sqlite3_stmt *stmt = NULL;
+
+    int rc = sql ? sqlite3_prepare_v2(conn, sql, -1, &stmt, NULL) : SQLITE_NOMEM;
+    sqlite3_free(sql);
+    while (rc == SQLITE_OK && (rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        rc = SQLITE_OK;
+        const char *result = (const char *)sqlite3_column_text(stmt, 0);
+        if (result && strcmp(result, "ok") == 0) {
+            continue;
+        }
+        if (problems == 0) {
+            log_error("Integrity check of table %s failed: %s", table, result ? result : "unknown error");
+        }
+        problems++;
+
+        pthread_mutex_lock(&check_mutex);
+        if (check_status.message[0] == '\0') {
+            snprintf(check_status.message, sizeof(check_status.message), "%s: %s",
+                     table, result ? result : "unknown error");
+        }
+        pthread_mutex_unlock(&check_mutex);
+    }
+    sqlite3_finalize(stmt);
+
+    *rc_out = rc == SQLITE_DONE ? SQLITE_OK : rc;
+    return problems;
+}
+
+static void *integrity_check_func(void *arg) {
+    (void)arg;
+    pthread_setname_np(pthread_self(), "db-integrity");
+
+    if (wait_for_stop(check_delay_sec * 1000)) {
+        finish_check(DB_INTEGRITY_ABORTED, "stopped before the check started");
+        return NULL;
+    }
+
+    sqlite3 *conn = NULL;
+    if (sqlite3_open_v2(check_path, &conn, SQLITE_OPEN_READONLY | SQLITE_OPEN_PRIVATECACHE, NULL) != SQLITE_OK) {
+        log_error("Failed to open integrity check connection: %s", conn ? sqlite3_errmsg(conn) : "out of memory");
+        sqlite3_close_v2(conn);
+        finish_check(DB_INTEGRITY_ABORTED, "cannot open the database");
+        return NULL;
+    }
+    sqlite3_busy_timeout(conn, 5000);
+    sqlite3_progress_handler(conn, INTEGRITY_PACE_STEPS, integrity_progress, NULL);
+
+    char **tables = NULL;
+    int count = list_tables(conn, &tables);
+
+    pthread_mutex_lock(&check_mutex);
+    check_db = conn;
+    check_status.state = DB_INTEGRITY_RUNNING;
+    check_status.started_at = time(NULL);
+    check_status.tables_total = count > 0 ? count : 0;
+    pthread_mutex_unlock(&check_mutex);
+
+    if (count >= 0) {
+        log_info("Background integrity check of %d tables started", count);
+    }
+
+    int errors = 0;
+    int rc = count < 0 ? sqlite3_errcode(conn) : SQLITE_OK;
+    for (int i = 0; i < count && rc == SQLITE_OK; i++) {
+        errors += check_table(conn, tables[i], &rc);
+
+        pthread_mutex_lock(&check_mutex);
+        check_status.tables_checked = i + 1;
+        check_status.errors = errors;
+        pthread_mutex_unlock(&check_mutex);
+
+        if (rc == SQLITE_OK && i + 1 < count && wait_for_stop(INTEGRITY_TABLE_PAUSE_MS)) {
+            rc = SQLITE_INTERRUPT;
+        }
+    }
+
+    // SQLite stops the check at pages it cannot make sense of
+    if ((rc & 0xff) == SQLITE_CORRUPT || rc == SQLITE_NOTADB) {
+        log_error("Integrity check stopped: %s", sqlite3_errmsg(conn));
+        errors++;
+        pthread_mutex_lock(&check_mutex);
+        check_status.errors = errors;
+        if (check_status.message[0] == '\0') {
+            snprintf(check_status.message, sizeof(check_status.message), "%s", sqlite3_errmsg(conn));
+        }
+        pthread_mutex_unlock(&check_mutex);
+    }
+
+    for (int i = 0; i < count; i++) {
+        free(tables[i]);
+    }
+    free(tables);
+
+    pthread_mutex_lock(&check_mutex);
+    check_db = NULL;
+    pthread_mutex_unlock(&check_mutex);
+    sqlite3_close_v2(conn);
+
+    if (errors > 0) {
+        log_error("Background integrity check found %d problems, repairing database", errors);
+
+        pthread_mutex_lock(&check_mutex);
+        check_status.repair_attempted = true;
+        pthread_mutex_unlock(&check_mutex);
+
+        lock_db_mutex();
+        bool repaired = check_and_repair_database() == 0;
+        pthread_mutex_unlock(get_db_mutex());
+
+        pthread_mutex_lock(&check_mutex);
+        check_status.repaired = repaired;
+        pthread_mutex_unlock(&check_mutex);
+        finish_check(DB_INTEGRITY_FAILED, NULL);
+    } else if (rc == SQLITE_INTERRUPT) {
+        log_info("Background integrity check stopped");
+        finish_check(DB_INTEGRITY_ABORTED, "stopped by shutdown");
+    } else if (rc != SQLITE_OK) {
+        log_warn("Background integrity check could not finish: %s", sqlite3_errstr(rc));
+        finish_check(DB_INTEGRITY_ABORTED, sqlite3_errstr(rc));
+    } else {
+        log_info("Background integrity check passed");
+        finish_check(DB_INTEGRITY_PASSED, NULL);
+    }
+    return NULL;
+}
+
+int start_integrity_check(const char *db_path, int delay_sec) {
+    pthread_mutex_lock(&check_mutex);
+    if (check_started) {
+        pthread_mutex_unlock(&check_mutex);
+        return 0;
+    }
+    snprintf(check_path, sizeof(check_path), "%s", db_path);
+    check_delay_sec = delay_sec > 0 ? delay_sec : 0;
+    check_stopping = false;
+    memset(&check_status, 0, sizeof(check_status));
+    check_status.state = DB_INTEGRITY_PENDING;
+
+    if (pthread_create(&check_thread, NULL, integrity_check_func, NULL) != 0) {
+        log_error("Failed to start background integrity check");
+        check_status.state = DB_INTEGRITY_IDLE;
+        pthread_mutex_unlock(&check_mutex);
+        return -1;
+    }
+    check_started = true;
+    pthread_mutex_unlock(&check_mutex);
+
+    log_info("Background integrity check scheduled in %d seconds", check_delay_sec);
+    return 0;
+}
+
+void stop_integrity_check(void) {
+    pthread_mutex_lock(&check_mutex);
+    if (!check_started) {
+        pthread_mutex_unlock(&check_mutex);
+        return;
+    }
+    __atomic_store_n(&check_stopping, true, __ATOMIC_RELAXED);
+    // Interrupts a table check that is not at a progress callback right now
+    if (check_db) {
+        sqlite3_interrupt(check_db);
+    }
+    pthread_cond_signal(&check_cond);
+    pthread_mutex_unlock(&check_mutex);
+
+    pthread_join(check_thread, NULL);
+
+    pthread_mutex_lock(&check_mutex);
+    check_started = false;
+    pthread_mutex_unlock(&check_mutex);
+}
+
+void get_integrity_status(db_integrity_status_t *status) {
+    pthread_mutex_lock(&check_mutex);
+    *status = check_status;
+    pthread_mutex_unlock(&check_mutex);
+}
+
+const char *integrity_state_name(db_integrity_state_t state) {
+    switch (state) {
+        case DB_INTEGRITY_PENDING: return "pending";
+        case DB_INTEGRITY_RUNNING: return "running";
+        case DB_INTEGRITY_PASSED:  return "passed";
+        case DB_INTEGRITY_FAILED:  return "failed";
+        case DB_INTEGRITY_ABORTED: return "aborted";
+        default:                   return "idle";
+    }
+}
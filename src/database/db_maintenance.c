@@ -30,7 +30,7 @@ int64_t get_database_size(void) {
         return -1;
     }
     
-    pthread_mutex_lock(db_mutex);
+    lock_db_mutex();
     
     const char *sql = "PRAGMA page_count;";
     
@@ -77,7 +77,7 @@ int vacuum_database(void) {
         return -1;
     }
     
-    pthread_mutex_lock(db_mutex);
+    lock_db_mutex();
     
     rc = sqlite3_exec(db, "VACUUM;", NULL, NULL, &err_msg);
     if (rc != SQLITE_OK) {
@@ -91,6 +91,144 @@ int vacuum_database(void) {
     return 0;
 }
 
+// Pause between retention batches, so queued queries get the database
+#define RETENTION_BATCH_PAUSE_US 20000
+
+// Pages freed per incremental vacuum step
+#define VACUUM_STEP_PAGES 256
+
+// Delete rows older than a cutoff in bounded batches
+int delete_rows_in_batches(const char *sql, time_t cutoff_time) {
+    sqlite3 *db = get_db_handle();
+    pthread_mutex_t *db_mutex = get_db_mutex();
+    sqlite3_stmt *stmt;
+    int deleted_count = 0;
+
+    if (!db || !sql) {
+        log_error("Database not initialized");
+        return -1;
+    }
+
+    lock_db_mutex();
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+        pthread_mutex_unlock(db_mutex);
+        return -1;
+    }
+
+    for (;;) {
+        sqlite3_bind_int64(stmt, 1, (sqlite3_int64)cutoff_time);
+        sqlite3_bind_int(stmt, 2, RETENTION_BATCH_ROWS);
+
+        int rc = sqlite3_step(stmt);
+        int changes = sqlite3_changes(db);
+        sqlite3_reset(stmt);
+        if (rc != SQLITE_DONE) {
+            log_error("Failed to delete batch of old rows: %s", sqlite3_errmsg(db));
+            if (deleted_count == 0) {
+                deleted_count = -1;
+            }
+            break;
+        }
+
+        deleted_count += changes;
+        if (changes < RETENTION_BATCH_ROWS) {
+            break;
+        }
+
+        // Let the writers and readers waiting on the mutex in before the next batch
+        pthread_mutex_unlock(db_mutex);
+        usleep(RETENTION_BATCH_PAUSE_US);
+        lock_db_mutex();
+
+        db = get_db_handle();
+        if (!db) {
+            // Closed during the pause, the statement went with it
+            pthread_mutex_unlock(db_mutex);
+            return deleted_count;
+        }
+    }
+
+    sqlite3_finalize(stmt);
+    pthread_mutex_unlock(db_mutex);
+    return deleted_count;
+}
+
+// Read a single integer pragma, must be called with the database mutex held
+static int64_t get_pragma_int(sqlite3 *db, const char *sql) {
+    sqlite3_stmt *stmt;
+    int64_t value = -1;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+        return -1;
+    }
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        value = sqlite3_column_int64(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+    return value;
+}
+
+// Return free pages to the file system a few at a time
+int incremental_vacuum_database(int max_pages) {
+    sqlite3 *db = get_db_handle();
+    pthread_mutex_t *db_mutex = get_db_mutex();
+    int freed = 0;
+
+    if (!db) {
+        log_error("Database not initialized");
+        return -1;
+    }
+
+    lock_db_mutex();
+    if (get_pragma_int(db, "PRAGMA auto_vacuum;") != 2) {
+        // Only databases created with auto_vacuum=INCREMENTAL can free pages this way
+        pthread_mutex_unlock(db_mutex);
+        return 0;
+    }
+
+    while (freed < max_pages) {
+        int64_t free_pages = get_pragma_int(db, "PRAGMA freelist_count;");
+        if (free_pages <= 0) {
+            break;
+        }
+
+        int step = VACUUM_STEP_PAGES;
+        if (step > free_pages) {
+            step = (int)free_pages;
+        }
+        if (step > max_pages - freed) {
+            step = max_pages - freed;
+        }
+
+        char sql[64];
+        snprintf(sql, sizeof(sql), "PRAGMA incremental_vacuum(%d);", step);
+        char *err_msg = NULL;
+        if (sqlite3_exec(db, sql, NULL, NULL, &err_msg) != SQLITE_OK) {
+            log_error("Failed to run incremental vacuum: %s", err_msg);
+            sqlite3_free(err_msg);
+            pthread_mutex_unlock(db_mutex);
+            return freed > 0 ? freed : -1;
+        }
+        freed += step;
+
+        pthread_mutex_unlock(db_mutex);
+        usleep(RETENTION_BATCH_PAUSE_US);
+        lock_db_mutex();
+
+        db = get_db_handle();
+        if (!db) {
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(db_mutex);
+    if (freed > 0) {
+        log_info("Incremental vacuum freed %d pages", freed);
+    }
+    return freed;
+}
+
 // Check database integrity with more detailed diagnostics
 int check_database_integrity(void) {
     int rc;
@@ -104,7 +242,7 @@ int check_database_integrity(void) {
         return -1;
     }
     
-    pthread_mutex_lock(db_mutex);
+    lock_db_mutex();
     
     // First run a quick check
     const char *sql = "PRAGMA quick_check;";
@@ -185,7 +323,7 @@ int database_execute_query(const char *sql, void **result, int *rows, int *cols)
         return -1;
     }
     
-    pthread_mutex_lock(db_mutex);
+    lock_db_mutex();
     
     // Execute the query and get results as a table
     rc = sqlite3_get_table(db, sql, (char ***)result, rows, cols, &err_msg);
@@ -0,0 +1,231 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+#include <sqlite3.h>
+
+#include "database/db_onvif_cache.h"
+#include "database/db_core.h"
+#include "core/logger.h"
+
+static void copy_column(sqlite3_stmt *stmt, int column, char *dest, size_t size) {
+    const char *text = (const char *)sqlite3_column_text(stmt, column);
+    if (text) {
+        strncpy(dest, text, size - 1);
+        dest[size - 1] = '\0';
+    } else {
+        dest[0] = '\0';
+    }
+}
+
+// Get the cached capabilities of a device
+int get_onvif_cache(const char *device_url, onvif_cache_info_t *info,
+                    onvif_profile_t *profiles, int max_profiles) {
+    sqlite3_stmt *stmt;
+
+    if (!device_url || !info || !profiles || max_profiles <= 0) {
+        return -1;
+    }
+
+    sqlite3 *db = acquire_db_reader();
+    if (!db) {
+        log_error("Database not initialized");
+        return -1;
+    }
+
+    if (sqlite3_prepare_v2(db, "SELECT firmware_version, media_url, updated_at "
+                               "FROM onvif_device_cache WHERE device_url = ?;",
+                           -1, &stmt, NULL) != SQLITE_OK) {
+        log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+        release_db_reader(db);
+        return -1;
+    }
+    sqlite3_bind_text(stmt, 1, device_url, -1, SQLITE_STATIC);
+
+    if (sqlite3_step(stmt) != SQLITE_ROW) {
+        sqlite3_finalize(stmt);
+        release_db_reader(db);
+        return -1;
+    }
+    memset(info, 0, sizeof(*info));
+    copy_column(stmt, 0, info->firmware_version, sizeof(info->firmware_version));
+    copy_column(stmt, 1, info->media_url, sizeof(info->media_url));
+    info->updated_at = (time_t)sqlite3_column_int64(stmt, 2);
+    sqlite3_finalize(stmt);
+
+    if (sqlite3_prepare_v2(db, "SELECT token, name, encoding, width, height, fps, bitrate, "
+                               "stream_uri, snapshot_uri FROM onvif_profile_cache "
+                               "WHERE device_url = ? ORDER BY position;",
+                           -1, &stmt, NULL) != SQLITE_OK) {
+        log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+        release_db_reader(db);
+        return -1;
+    }
+    sqlite3_bind_text(stmt, 1, device_url, -1, SQLITE_STATIC);
+
+    int count = 0;
+    while (count < max_profiles && sqlite3_step(stmt) == SQLITE_ROW) {
+        onvif_profile_t *profile = &profiles[count++];
+        memset(profile, 0, sizeof(*profile));
+        copy_column(stmt, 0, profile->token, sizeof(profile->token));
+        copy_column(stmt, 1, profile->name, sizeof(profile->name));
+        copy_column(stmt, 2, profile->encoding, sizeof(profile->encoding));
+        profile->width = sqlite3_column_int(stmt, 3);
+        profile->height = sqlite3_column_int(stmt, 4);
+        profile->fps = sqlite3_column_int(stmt, 5);
+        profile->bitrate = sqlite3_column_int(stmt, 6);
+        copy_column(stmt, 7, profile->stream_uri, sizeof(profile->stream_uri));
+        copy_column(stmt, 8, profile->snapshot_uri, sizeof(profile->snapshot_uri));
+    }
+    sqlite3_finalize(stmt);
+    release_db_reader(db);
+
+    return count;
+}
+
+// Replace the cached capabilities of a device
+int store_onvif_cache(const char *device_url, const onvif_cache_info_t *info,
+                      const onvif_profile_t *profiles, int count) {
+    sqlite3_stmt *stmt = NULL;
+    char *err_msg = NULL;
+
+    if (!device_url || !info || (count > 0 && !profiles)) {
+        return -1;
+    }
+
+    sqlite3 *db = get_db_handle();
+    pthread_mutex_t *db_mutex = get_db_mutex();
+
+    if (!db) {
+        log_error("Database not initialized");
+        return -1;
+    }
+
+    lock_db_mutex();
+
+    if (sqlite3_exec(db, "BEGIN TRANSACTION;", NULL, NULL, &err_msg) != SQLITE_OK) {
+        log_error("Failed to begin transaction: %s", err_msg);
+        sqlite3_free(err_msg);
+        pthread_mutex_unlock(db_mutex);
+        return -1;
+    }
+
+    int rc = sqlite3_prepare_v2(db, "INSERT OR REPLACE INTO onvif_device_cache "
+                                    "(device_url, firmware_version, media_url, updated_at) "
+                                    "VALUES (?, ?, ?, ?);", -1, &stmt, NULL);
+    if (rc == SQLITE_OK) {
+        sqlite3_bind_text(stmt, 1, device_url, -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 2, info->firmware_version, -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 3, info->media_url, -1, SQLITE_STATIC);
+        sqlite3_bind_int64(stmt, 4, (sqlite3_int64)info->updated_at);
+        rc = sqlite3_step(stmt) == SQLITE_DONE ? SQLITE_OK : SQLITE_ERROR;
+        sqlite3_finalize(stmt);
+    }
+
+    if (rc == SQLITE_OK) {
+        rc = sqlite3_prepare_v2(db, "DELETE FROM onvif_profile_cache WHERE device_url = ?;",
+                                -1, &stmt, NULL);
+    }
+    if (rc == SQLITE_OK) {
+        sqlite3_bind_text(stmt, 1, device_url, -1, SQLITE_STATIC);
+        rc = sqlite3_step(stmt) == SQLITE_DONE ? SQLITE_OK : SQLITE_ERROR;
+        sqlite3_finalize(stmt);
+    }
+
+    if (rc == SQLITE_OK) {
+        rc = sqlite3_prepare_v2(db, "INSERT INTO onvif_profile_cache "
+                                    "(device_url, position, token, name, encoding, width, height, "
+                                    "fps, bitrate, stream_uri, snapshot_uri) "
+                                    "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?);", -1, &stmt, NULL);
+        for (int i = 0; i < count && rc == SQLITE_OK; i++) {
+            sqlite3_bind_text(stmt, 1, device_url, -1, SQLITE_STATIC);
+            sqlite3_bind_int(stmt, 2, i);
+            sqlite3_bind_text(stmt, 3, profiles[i].token, -1, SQLITE_STATIC);
+            sqlite3_bind_text(stmt, 4, profiles[i].name, -1, SQLITE_STATIC);
+            sqlite3_bind_text(stmt, 5, profiles[i].encoding, -1, SQLITE_STATIC);
+            sqlite3_bind_int(stmt, 6, profiles[i].width);
+            sqlite3_bind_int(stmt, 7, profiles[i].height);
+            sqlite3_bind_int(stmt, 8, profiles[i].fps);
+            sqlite3_bind_int(stmt, 9, profiles[i].bitrate);
+            sqlite3_bind_text(stmt, 10, profiles[i].stream_uri, -1, SQLITE_STATIC);
+            sqlite3_bind_text(stmt, 11, profiles[i].snapshot_uri, -1, SQLITE_STATIC);
+            rc = sqlite3_step(stmt) == SQLITE_DONE ? SQLITE_OK : SQLITE_ERROR;
+            sqlite3_reset(stmt);
+        }
+        sqlite3_finalize(stmt);
+    }
+
+    if (rc != SQLITE_OK || sqlite3_exec(db, "COMMIT;", NULL, NULL, &err_msg) != SQLITE_OK) {
+        log_error("Failed to cache ONVIF device %s: %s", device_url, err_msg ? err_msg : sqlite3_errmsg(db));
+        sqlite3_free(err_msg);
+        sqlite3_exec(db, "ROLLBACK;", NULL, NULL, NULL);
+        pthread_mutex_unlock(db_mutex);
+        return -1;
+    }
+
+    pthread_mutex_unlock(db_mutex);
+    return 0;
+}
+
+/**
+ * Run a statement on the cache rows of one device
+ * The device URL is the last parameter, preceded by updated_at if with_time.
+ */
+static int exec_for_device(const char *sql, const char *device_url, time_t updated_at, bool with_time) {
+    sqlite3_stmt *stmt;
+
+    sqlite3 *db = get_db_handle();
+    pthread_mutex_t *db_mutex = get_db_mutex();
+
+    if (!db) {
+        log_error("Database not initialized");
+        return -1;
+    }
+
+    lock_db_mutex();
+
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+        pthread_mutex_unlock(db_mutex);
+        return -1;
+    }
+    int param = 1;
+    if (with_time) {
+        sqlite3_bind_int64(stmt, param++, (sqlite3_int64)updated_at);
+    }
+    sqlite3_bind_text(stmt, param, device_url, -1, SQLITE_STATIC);
+
+    int rc = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    if (rc != SQLITE_DONE) {
+        log_error("Failed to update ONVIF cache for %s: %s", device_url, sqlite3_errmsg(db));
+        pthread_mutex_unlock(db_mutex);
+        return -1;
+    }
+
+    pthread_mutex_unlock(db_mutex);
+    return 0;
+}
+
+// Mark the cached capabilities of a device as current
+int touch_onvif_cache(const char *device_url, time_t updated_at) {
+    if (!device_url) {
+        return -1;
+    }
+    return exec_for_device("UPDATE onvif_device_cache SET updated_at = ? WHERE device_url = ?;",
+                           device_url, updated_at, true);
+}
+
+// Forget the cached capabilities of a device
+int delete_onvif_cache(const char *device_url) {
+    if (!device_url) {
+        return -1;
+    }
+    int rc = exec_for_device("DELETE FROM onvif_profile_cache WHERE device_url = ?;", device_url, 0, false);
+    if (rc == 0) {
+        rc = exec_for_device("DELETE FROM onvif_device_cache WHERE device_url = ?;", device_url, 0, false);
+    }
+    return rc;
+}
@@ -0,0 +1,203 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sqlite3.h>
+
+#include "database/db_partitions.h"
+#include "core/logger.h"
+
+#define SECONDS_PER_DAY 86400
+
+// Tables that are partitioned, each with the last day known to have a partition
+#define MAX_PARTITIONED_TABLES 4
+
+typedef struct {
+    char base[32];
+    int day;
+} ensured_partition_t;
+
+// Guarded by the database mutex, like the partitions themselves
+static ensured_partition_t ensured[MAX_PARTITIONED_TABLES];
+static int ensured_count = 0;
+
+int partition_day(time_t t) {
+    if (t < 0) {
+        return 0;
+    }
+    return (int)(t / SECONDS_PER_DAY);
+}
+
+void partition_name(const char *base, int day, char *name, size_t name_size) {
+    time_t t = (time_t)day * SECONDS_PER_DAY;
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    snprintf(name, name_size, "%s_%04d%02d%02d", base,
+             tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday);
+}
+
+/**
+ * Get the day of a partition from its name
+ *
+ * @return Partition day, or -1 if the name is not a partition of base
+ */
+static int parse_partition_name(const char *base, const char *name) {
+    size_t base_len = strlen(base);
+    if (strncmp(name, base, base_len) != 0 || name[base_len] != '_') {
+        return -1;
+    }
+
+    const char *suffix = name + base_len + 1;
+    if (strlen(suffix) != 8 || strspn(suffix, "0123456789") != 8) {
+        return -1;
+    }
+
+    struct tm tm = {0};
+    int year, month, mday;
+    if (sscanf(suffix, "%4d%2d%2d", &year, &month, &mday) != 3) {
+        return -1;
+    }
+    tm.tm_year = year - 1900;
+    tm.tm_mon = month - 1;
+    tm.tm_mday = mday;
+    return partition_day(timegm(&tm));
+}
+
+static ensured_partition_t *find_ensured(const char *base) {
+    for (int i = 0; i < ensured_count; i++) {
+        if (strcmp(ensured[i].base, base) == 0) {
+            return &ensured[i];
+        }
+    }
+    if (ensured_count == MAX_PARTITIONED_TABLES) {
+        return NULL;
+    }
+    ensured_partition_t *entry = &ensured[ensured_count++];
+    strncpy(entry->base, base, sizeof(entry->base) - 1);
+    entry->base[sizeof(entry->base) - 1] = '\0';
+    entry->day = -1;
+    return entry;
+}
+
+int ensure_partition(sqlite3 *db, const char *base, int day, const char *columns,
+                     const char *index_columns) {
+    ensured_partition_t *entry = find_ensured(base);
+    if (entry && entry->day == day) {
+        return 0;
+    }
+
+    char name[MAX_PARTITION_NAME];
+    partition_name(base, day, name, sizeof(name));
+
+    char *sql = sqlite3_mprintf("CREATE TABLE IF NOT EXISTS \"%w\" (%s);"
+                                "CREATE INDEX IF NOT EXISTS \"idx_%w\" ON \"%w\" (%s);",
+                                name, columns, name, name, index_columns);
+    if (!sql) {
+        return -1;
+    }
+
+    char *err_msg = NULL;
+    int rc = sqlite3_exec(db, sql, NULL, NULL, &err_msg);
+    sqlite3_free(sql);
+    if (rc != SQLITE_OK) {
+        log_error("Failed to create partition %s: %s", name, err_msg);
+        sqlite3_free(err_msg);
+        return -1;
+    }
+
+    if (entry) {
+        entry->day = day;
+    }
+    return 0;
+}
+
+static int compare_days_desc(const void *a, const void *b) {
+    int da = *(const int *)a;
+    int db = *(const int *)b;
+    return (da < db) - (da > db);
+}
+
+int list_partitions(sqlite3 *db, const char *base, int first_day, int last_day,
+                    int *days, int max_days) {
+    char *sql = sqlite3_mprintf("SELECT name FROM sqlite_master "
+                                "WHERE type = 'table' AND name GLOB '%q_[0-9]*';", base);
+    if (!sql) {
+        return -1;
+    }
+
+    sqlite3_stmt *stmt;
+    int rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+    sqlite3_free(sql);
+    if (rc != SQLITE_OK) {
+        log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+        return -1;
+    }
+
+    // Collect all, then keep the newest when there are more than fit
+    int all_days[MAX_QUERY_PARTITIONS * 8];
+    int all_count = 0;
+    while (sqlite3_step(stmt) == SQLITE_ROW && all_count < (int)(sizeof(all_days) / sizeof(all_days[0]))) {
+        const char *name = (const char *)sqlite3_column_text(stmt, 0);
+        int day = name ? parse_partition_name(base, name) : -1;
+        if (day >= first_day && day <= last_day) {
+            all_days[all_count++] = day;
+        }
+    }
+    sqlite3_finalize(stmt);
+
+    qsort(all_days, all_count, sizeof(int), compare_days_desc);
+
+    int count = all_count < max_days ? all_count : max_days;
+    memcpy(days, all_days, count * sizeof(int));
+    return count;
+}
+
+int drop_partitions_before(sqlite3 *db, const char *base, int day) {
+    int days[MAX_QUERY_PARTITIONS];
+    int dropped = 0;
+
+    // A day's table is dropped whole, so each round frees a batch of days
+    for (;;) {
+        int count = list_partitions(db, base, 0, day - 1, days, MAX_QUERY_PARTITIONS);
+        if (count < 0) {
+            return -1;
+        }
+        if (count == 0) {
+            break;
+        }
+
+        for (int i = 0; i < count; i++) {
+            char name[MAX_PARTITION_NAME];
+            partition_name(base, days[i], name, sizeof(name));
+
+            char *sql = sqlite3_mprintf("DROP TABLE IF EXISTS \"%w\";", name);
+            if (!sql) {
+                return -1;
+            }
+
+            char *err_msg = NULL;
+            int rc = sqlite3_exec(db, sql, NULL, NULL, &err_msg);
+            sqlite3_free(sql);
+            if (rc != SQLITE_OK) {
+                log_error("Failed to drop partition %s: %s", name, err_msg);
+                sqlite3_free(err_msg);
+                return -1;
+            }
+            log_info("Dropped expired partition %s", name);
+            dropped++;
+        }
+    }
+
+    ensured_partition_t *entry = find_ensured(base);
+    if (entry && entry->day < day) {
+        entry->day = -1;
+    }
+    return dropped;
+}
+
+void reset_partition_cache(void) {
+    memset(ensured, 0, sizeof(ensured));
+    ensured_count = 0;
+}
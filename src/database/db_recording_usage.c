@@ -0,0 +1,352 @@
+#define _POSIX_C_SOURCE 200809L
+#define _XOPEN_SOURCE 700
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <sqlite3.h>
+
+#include "database/db_recording_usage.h"
+#include "database/db_core.h"
+#include "database/db_streams.h"
+#include "core/logger.h"
+
+typedef struct {
+    recording_usage_t usage;
+    bool oldest_stale;       // Recordings were deleted since oldest_time was known
+} usage_entry_t;
+
+// Lock order: database mutex, then usage_mutex
+static usage_entry_t entries[MAX_USAGE_STREAMS];
+static int entry_count = 0;
+static bool reconciled = false;
+static pthread_mutex_t usage_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Recent changes, for recordings_changed_since(); an empty stream name
+// stands for every stream
+#define CHANGE_LOG_SIZE 256
+
+typedef struct {
+    uint64_t seq;
+    char stream_name[64];
+    time_t start_time;
+    time_t end_time;
+} change_entry_t;
+
+static change_entry_t change_log[CHANGE_LOG_SIZE];
+static uint64_t change_seq = 0;
+
+/**
+ * Log a change to the recordings of a stream within a time span
+ * Must be called with usage_mutex held.
+ */
+static void log_change(const char *stream_name, time_t start_time, time_t end_time) {
+    change_entry_t *change = &change_log[++change_seq % CHANGE_LOG_SIZE];
+    change->seq = change_seq;
+    strncpy(change->stream_name, stream_name, sizeof(change->stream_name) - 1);
+    change->stream_name[sizeof(change->stream_name) - 1] = '\0';
+    change->start_time = start_time;
+    change->end_time = end_time > start_time ? end_time : start_time;
+}
+
+/**
+ * Find the entry of a stream, adding it if needed
+ * Must be called with usage_mutex held.
+ */
+static usage_entry_t *find_entry(const char *stream_name, bool create) {
+    for (int i = 0; i < entry_count; i++) {
+        if (strcmp(entries[i].usage.stream_name, stream_name) == 0) {
+            return &entries[i];
+        }
+    }
+    if (!create || entry_count == MAX_USAGE_STREAMS) {
+        return NULL;
+    }
+
+    usage_entry_t *entry = &entries[entry_count++];
+    memset(entry, 0, sizeof(*entry));
+    strncpy(entry->usage.stream_name, stream_name, sizeof(entry->usage.stream_name) - 1);
+    return entry;
+}
+
+void recording_usage_add(const char *stream_name, uint64_t size_bytes, time_t start_time, time_t end_time) {
+    if (!stream_name) {
+        return;
+    }
+
+    pthread_mutex_lock(&usage_mutex);
+    usage_entry_t *entry = find_entry(stream_name, true);
+    if (entry) {
+        recording_usage_t *u = &entry->usage;
+        u->size_bytes += size_bytes;
+        u->recording_count++;
+        if (u->oldest_time == 0 || start_time < u->oldest_time) {
+            u->oldest_time = start_time;
+        }
+        time_t newest = end_time > start_time ? end_time : start_time;
+        if (newest > u->newest_time) {
+            u->newest_time = newest;
+        }
+    }
+    log_change(stream_name, start_time, end_time);
+    pthread_mutex_unlock(&usage_mutex);
+}
+
+void recording_usage_resize(const char *stream_name, int64_t size_delta, time_t start_time, time_t end_time) {
+    if (!stream_name) {
+        return;
+    }
+
+    pthread_mutex_lock(&usage_mutex);
+    usage_entry_t *entry = find_entry(stream_name, false);
+    if (entry) {
+        recording_usage_t *u = &entry->usage;
+        if (size_delta < 0 && (uint64_t)-size_delta > u->size_bytes) {
+            u->size_bytes = 0;
+        } else {
+            u->size_bytes += size_delta;
+        }
+        if (end_time > u->newest_time) {
+            u->newest_time = end_time;
+        }
+    }
+    log_change(stream_name, start_time, end_time);
+    pthread_mutex_unlock(&usage_mutex);
+}
+
+void recording_usage_remove(const char *stream_name, int count, uint64_t size_bytes,
+                            time_t start_time, time_t end_time) {
+    if (!stream_name || count <= 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&usage_mutex);
+    usage_entry_t *entry = find_entry(stream_name, false);
+    if (entry) {
+        recording_usage_t *u = &entry->usage;
+        u->size_bytes = size_bytes < u->size_bytes ? u->size_bytes - size_bytes : 0;
+        u->recording_count = count < u->recording_count ? u->recording_count - count : 0;
+        if (u->recording_count == 0) {
+            u->size_bytes = 0;
+            u->oldest_time = 0;
+            u->newest_time = 0;
+            entry->oldest_stale = false;
+        } else {
+            entry->oldest_stale = true;
+        }
+    }
+    log_change(stream_name, start_time, end_time);
+    pthread_mutex_unlock(&usage_mutex);
+}
+
+int reconcile_recording_usage(void) {
+    sqlite3 *db = get_db_handle();
+    pthread_mutex_t *db_mutex = get_db_mutex();
+
+    if (!db) {
+        log_error("Database not initialized");
+        return -1;
+    }
+
+    const char *sql = "SELECT stream_name, COUNT(*), SUM(size_bytes), MIN(start_time), "
+                      "MAX(COALESCE(end_time, start_time)) "
+                      "FROM recordings GROUP BY stream_id;";
+
+    // Held throughout, so no recording is added or deleted between the
+    // query and the swap
+    lock_db_mutex();
+
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+        pthread_mutex_unlock(db_mutex);
+        return -1;
+    }
+
+    usage_entry_t fresh[MAX_USAGE_STREAMS];
+    int fresh_count = 0;
+    while (fresh_count < MAX_USAGE_STREAMS && sqlite3_step(stmt) == SQLITE_ROW) {
+        const char *name = (const char *)sqlite3_column_text(stmt, 0);
+        if (!name) {
+            continue;
+        }
+        usage_entry_t *entry = &fresh[fresh_count++];
+        memset(entry, 0, sizeof(*entry));
+        strncpy(entry->usage.stream_name, name, sizeof(entry->usage.stream_name) - 1);
+        entry->usage.recording_count = sqlite3_column_int(stmt, 1);
+        entry->usage.size_bytes = (uint64_t)sqlite3_column_int64(stmt, 2);
+        entry->usage.oldest_time = (time_t)sqlite3_column_int64(stmt, 3);
+        entry->usage.newest_time = (time_t)sqlite3_column_int64(stmt, 4);
+    }
+    sqlite3_finalize(stmt);
+
+    pthread_mutex_lock(&usage_mutex);
+    memcpy(entries, fresh, fresh_count * sizeof(usage_entry_t));
+    entry_count = fresh_count;
+    reconciled = true;
+    // Whatever drift was corrected may have been anywhere
+    log_change("", 0, (time_t)INT64_MAX);
+    pthread_mutex_unlock(&usage_mutex);
+
+    pthread_mutex_unlock(db_mutex);
+
+    log_debug("Reconciled recording usage of %d streams", fresh_count);
+    return fresh_count;
+}
+
+/**
+ * Look up the start of the oldest recording of a stream
+ * Uses the (is_complete, stream_id, start_time) index, so it costs two
+ * index seeks however many recordings the stream has.
+ *
+ * @return Start time, or 0 if the stream has no recordings
+ */
+static time_t query_oldest_time(sqlite3 *db, const char *stream_name) {
+    const char *sql = "SELECT MIN(start_time) FROM recordings "
+                      "WHERE is_complete = ? AND stream_id = " STREAM_ID_OF("?") ";";
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+        return 0;
+    }
+
+    time_t oldest = 0;
+    for (int complete = 0; complete <= 1; complete++) {
+        sqlite3_bind_int(stmt, 1, complete);
+        sqlite3_bind_text(stmt, 2, stream_name, -1, SQLITE_STATIC);
+        if (sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_type(stmt, 0) != SQLITE_NULL) {
+            time_t t = (time_t)sqlite3_column_int64(stmt, 0);
+            if (oldest == 0 || t < oldest) {
+                oldest = t;
+            }
+        }
+        sqlite3_reset(stmt);
+    }
+    sqlite3_finalize(stmt);
+    return oldest;
+}
+
+/**
+ * Look up the oldest time of streams that had recordings deleted
+ * Must be called without usage_mutex or the database mutex held.
+ */
+static void refresh_stale_oldest(void) {
+    char stale[MAX_USAGE_STREAMS][64];
+    int stale_count = 0;
+
+    pthread_mutex_lock(&usage_mutex);
+    for (int i = 0; i < entry_count; i++) {
+        if (entries[i].oldest_stale) {
+            memcpy(stale[stale_count++], entries[i].usage.stream_name, sizeof(stale[0]));
+        }
+    }
+    pthread_mutex_unlock(&usage_mutex);
+
+    if (stale_count == 0) {
+        return;
+    }
+
+    sqlite3 *db = acquire_db_reader();
+    if (!db) {
+        return;
+    }
+    for (int i = 0; i < stale_count; i++) {
+        time_t oldest = query_oldest_time(db, stale[i]);
+
+        pthread_mutex_lock(&usage_mutex);
+        usage_entry_t *entry = find_entry(stale[i], false);
+        if (entry && entry->oldest_stale) {
+            entry->usage.oldest_time = oldest;
+            entry->oldest_stale = false;
+        }
+        pthread_mutex_unlock(&usage_mutex);
+    }
+    release_db_reader(db);
+}
+
+int get_recording_usage(recording_usage_t *usage, int max_streams) {
+    if (!usage || max_streams <= 0) {
+        return -1;
+    }
+
+    refresh_stale_oldest();
+
+    pthread_mutex_lock(&usage_mutex);
+    if (!reconciled) {
+        pthread_mutex_unlock(&usage_mutex);
+        return -1;
+    }
+
+    int count = 0;
+    for (int i = 0; i < entry_count && count < max_streams; i++) {
+        if (entries[i].usage.recording_count > 0) {
+            usage[count++] = entries[i].usage;
+        }
+    }
+    pthread_mutex_unlock(&usage_mutex);
+
+    return count;
+}
+
+int get_recording_usage_totals(recording_usage_t *totals) {
+    if (!totals) {
+        return -1;
+    }
+
+    refresh_stale_oldest();
+
+    memset(totals, 0, sizeof(*totals));
+
+    pthread_mutex_lock(&usage_mutex);
+    if (!reconciled) {
+        pthread_mutex_unlock(&usage_mutex);
+        return -1;
+    }
+
+    for (int i = 0; i < entry_count; i++) {
+        const recording_usage_t *u = &entries[i].usage;
+        if (u->recording_count == 0) {
+            continue;
+        }
+        totals->size_bytes += u->size_bytes;
+        totals->recording_count += u->recording_count;
+        if (u->oldest_time > 0 && (totals->oldest_time == 0 || u->oldest_time < totals->oldest_time)) {
+            totals->oldest_time = u->oldest_time;
+        }
+        if (u->newest_time > totals->newest_time) {
+            totals->newest_time = u->newest_time;
+        }
+    }
+    pthread_mutex_unlock(&usage_mutex);
+
+    return 0;
+}
+
+uint64_t get_recording_change_seq(void) {
+    pthread_mutex_lock(&usage_mutex);
+    uint64_t seq = change_seq;
+    pthread_mutex_unlock(&usage_mutex);
+    return seq;
+}
+
+bool recordings_changed_since(uint64_t seq, const char *stream_name, time_t start_time, time_t end_time) {
+    if (!stream_name) {
+        return true;
+    }
+
+    pthread_mutex_lock(&usage_mutex);
+    bool changed = change_seq - seq >= CHANGE_LOG_SIZE;
+    for (uint64_t s = seq + 1; !changed && s <= change_seq; s++) {
+        const change_entry_t *change = &change_log[s % CHANGE_LOG_SIZE];
+        changed = (change->stream_name[0] == '\0' || strcmp(change->stream_name, stream_name) == 0) &&
+                  change->start_time <= end_time && change->end_time >= start_time;
+    }
+    pthread_mutex_unlock(&usage_mutex);
+
+    return changed;
+}
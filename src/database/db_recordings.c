@@ -6,12 +6,84 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <stdint.h>
 #include <sqlite3.h>
 #include <stdbool.h>
+#include <pthread.h>
 
 #include "database/db_recordings.h"
 #include "database/db_core.h"
+#include "database/db_recording_usage.h"
+#include "database/db_streams.h"
 #include "core/logger.h"
+#include "core/config.h"
+
+/**
+ * Look up what the usage totals need to know of a recording
+ * Must be called with the database mutex held.
+ *
+ * @return 0 on success, -1 if the recording does not exist
+ */
+static int lookup_recording_usage(uint64_t id, char *stream_name, size_t stream_name_size,
+                                  uint64_t *size_bytes, time_t *start_time, time_t *end_time) {
+    sqlite3_stmt *stmt = get_cached_stmt(DB_STMT_RECORDING_SIZE,
+                                         "SELECT stream_name, size_bytes, start_time, end_time "
+                                         "FROM recordings WHERE id = ?;");
+    if (!stmt) {
+        return -1;
+    }
+
+    sqlite3_bind_int64(stmt, 1, (sqlite3_int64)id);
+
+    int result = -1;
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        const char *name = (const char *)sqlite3_column_text(stmt, 0);
+        strncpy(stream_name, name ? name : "", stream_name_size - 1);
+        stream_name[stream_name_size - 1] = '\0';
+        *size_bytes = (uint64_t)sqlite3_column_int64(stmt, 1);
+        *start_time = (time_t)sqlite3_column_int64(stmt, 2);
+        *end_time = (time_t)sqlite3_column_int64(stmt, 3);
+        result = 0;
+    }
+
+    release_cached_stmt(stmt);
+    return result;
+}
+
+// Streams seen before get their ID here, saving the trigger's update
+#define RECORDING_INSERT_SQL \
+    "INSERT INTO recordings (stream_name, file_path, start_time, end_time, " \
+    "size_bytes, width, height, fps, codec, is_complete, stream_id) " \
+    "VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9, ?10, " STREAM_ID_OF("?1") ");"
+
+#define RECORDING_UPDATE_SQL \
+    "UPDATE recordings SET end_time = ?, size_bytes = ?, is_complete = ? WHERE id = ?;"
+
+// Recordings r with a detection in a minute they overlap. detection_activity
+// covers the detections table, compact blocks and day partitions alike.
+#define HAS_DETECTION_FILTER \
+    "EXISTS (SELECT 1 FROM detection_activity a WHERE a.stream_id = r.stream_id " \
+    "AND a.minute BETWEEN r.start_time - 59 AND r.end_time)"
+
+// Bind one recording to the insert statement
+static void bind_recording_insert(sqlite3_stmt *stmt, const recording_metadata_t *metadata) {
+    sqlite3_bind_text(stmt, 1, metadata->stream_name, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, metadata->file_path, -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 3, (sqlite3_int64)metadata->start_time);
+    
+    if (metadata->end_time > 0) {
+        sqlite3_bind_int64(stmt, 4, (sqlite3_int64)metadata->end_time);
+    } else {
+        sqlite3_bind_null(stmt, 4);
+    }
+    
+    sqlite3_bind_int64(stmt, 5, (sqlite3_int64)metadata->size_bytes);
+    sqlite3_bind_int(stmt, 6, metadata->width);
+    sqlite3_bind_int(stmt, 7, metadata->height);
+    sqlite3_bind_int(stmt, 8, metadata->fps);
+    sqlite3_bind_text(stmt, 9, metadata->codec, -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 10, metadata->is_complete ? 1 : 0);
+}
 
 // Add recording metadata to the database
 uint64_t add_recording_metadata(const recording_metadata_t *metadata) {
@@ -32,38 +104,15 @@ uint64_t add_recording_metadata(const recording_metadata_t *metadata) {
         return 0;
     }
     
-    pthread_mutex_lock(db_mutex);
-    
-    const char *sql = "INSERT INTO recordings (stream_name, file_path, start_time, end_time, "
-                      "size_bytes, width, height, fps, codec, is_complete) "
-                      "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?);";
+    lock_db_mutex();
     
-    rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
-        log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+    stmt = get_cached_stmt(DB_STMT_RECORDING_INSERT, RECORDING_INSERT_SQL);
+    if (!stmt) {
         pthread_mutex_unlock(db_mutex);
         return 0;
     }
     
-    // No longer tracking statements - each function is responsible for finalizing its own statements
-    
-    // Bind parameters
-    sqlite3_bind_text(stmt, 1, metadata->stream_name, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 2, metadata->file_path, -1, SQLITE_STATIC);
-    sqlite3_bind_int64(stmt, 3, (sqlite3_int64)metadata->start_time);
-    
-    if (metadata->end_time > 0) {
-        sqlite3_bind_int64(stmt, 4, (sqlite3_int64)metadata->end_time);
-    } else {
-        sqlite3_bind_null(stmt, 4);
-    }
-    
-    sqlite3_bind_int64(stmt, 5, (sqlite3_int64)metadata->size_bytes);
-    sqlite3_bind_int(stmt, 6, metadata->width);
-    sqlite3_bind_int(stmt, 7, metadata->height);
-    sqlite3_bind_int(stmt, 8, metadata->fps);
-    sqlite3_bind_text(stmt, 9, metadata->codec, -1, SQLITE_STATIC);
-    sqlite3_bind_int(stmt, 10, metadata->is_complete ? 1 : 0);
+    bind_recording_insert(stmt, metadata);
     
     // Execute statement
     rc = sqlite3_step(stmt);
@@ -72,21 +121,19 @@ uint64_t add_recording_metadata(const recording_metadata_t *metadata) {
     } else {
         recording_id = (uint64_t)sqlite3_last_insert_rowid(db);
         log_debug("Added recording metadata with ID %llu", (unsigned long long)recording_id);
+        recording_usage_add(metadata->stream_name, metadata->size_bytes,
+                            metadata->start_time, metadata->end_time);
     }
     
-    // Finalize the prepared statement
-    sqlite3_finalize(stmt);
+    // Hand back the cached statement
+    release_cached_stmt(stmt);
     pthread_mutex_unlock(db_mutex);
     
     return recording_id;
 }
 
-// Update recording metadata in the database
-int update_recording_metadata(uint64_t id, time_t end_time, 
-                             uint64_t size_bytes, bool is_complete) {
-    int rc;
-    sqlite3_stmt *stmt;
-    
+// Add recordings in one transaction
+int add_recording_metadata_batch(const recording_metadata_t *metadata, int count) {
     sqlite3 *db = get_db_handle();
     pthread_mutex_t *db_mutex = get_db_mutex();
     
@@ -95,19 +142,96 @@ int update_recording_metadata(uint64_t id, time_t end_time,
         return -1;
     }
     
-    pthread_mutex_lock(db_mutex);
+    if (!metadata || count <= 0) {
+        return 0;
+    }
     
-    const char *sql = "UPDATE recordings SET end_time = ?, size_bytes = ?, is_complete = ? "
-                      "WHERE id = ?;";
+    lock_db_mutex();
     
-    rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
-        log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+    char *err_msg = NULL;
+    if (sqlite3_exec(db, "BEGIN TRANSACTION;", NULL, NULL, &err_msg) != SQLITE_OK) {
+        log_error("Failed to begin transaction: %s", err_msg);
+        sqlite3_free(err_msg);
         pthread_mutex_unlock(db_mutex);
         return -1;
     }
     
-    // No longer tracking statements - each function is responsible for finalizing its own statements
+    sqlite3_stmt *stmt = get_cached_stmt(DB_STMT_RECORDING_INSERT, RECORDING_INSERT_SQL);
+    int rc = stmt ? SQLITE_OK : SQLITE_ERROR;
+    for (int i = 0; i < count && rc == SQLITE_OK; i++) {
+        bind_recording_insert(stmt, &metadata[i]);
+        rc = sqlite3_step(stmt) == SQLITE_DONE ? SQLITE_OK : SQLITE_ERROR;
+        release_cached_stmt(stmt);
+    }
+    
+    if (rc != SQLITE_OK || sqlite3_exec(db, "COMMIT;", NULL, NULL, &err_msg) != SQLITE_OK) {
+        log_error("Failed to add %d recordings: %s", count, err_msg ? err_msg : sqlite3_errmsg(db));
+        sqlite3_free(err_msg);
+        sqlite3_exec(db, "ROLLBACK;", NULL, NULL, NULL);
+        pthread_mutex_unlock(db_mutex);
+        return -1;
+    }
+    
+    for (int i = 0; i < count; i++) {
+        recording_usage_add(metadata[i].stream_name, metadata[i].size_bytes,
+                            metadata[i].start_time, metadata[i].end_time);
+    }
+    pthread_mutex_unlock(db_mutex);
+    
+    return count;
+}
+
+// Updates the writer holds at most; further recordings are updated directly
+#define RECORDING_UPDATE_SLOTS (MAX_STREAMS * 2)
+
+// Pending updates are written this often, finalizations right away
+#define RECORDING_UPDATE_FLUSH_MS 2000
+
+// Latest update of a recording waiting for the writer thread
+typedef struct {
+    uint64_t id;
+    time_t end_time;
+    uint64_t size_bytes;
+    bool is_complete;
+} pending_recording_update_t;
+
+static pending_recording_update_t pending_updates[RECORDING_UPDATE_SLOTS];
+static int pending_count = 0;
+static bool flush_now = false;                  // A finalization is waiting
+static uint64_t update_generation = 1;          // Batch pending updates go into
+static uint64_t flushed_generation = 0;         // Last batch written
+static uint64_t failed_generation = 0;          // Last batch that failed
+static pthread_mutex_t updates_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t updates_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t flushed_cond = PTHREAD_COND_INITIALIZER;
+
+static pthread_t update_writer_thread;
+static bool update_writer_running = false;
+
+// Owned by the writer thread
+static pending_recording_update_t writer_updates[RECORDING_UPDATE_SLOTS];
+
+/**
+ * Write one update of a recording
+ * Must be called with the database mutex held.
+ */
+static int apply_recording_update(sqlite3 *db, uint64_t id, time_t end_time,
+                                  uint64_t size_bytes, bool is_complete) {
+    int rc;
+    sqlite3_stmt *stmt;
+    
+    // The usage totals take the change in size
+    char stream_name[64];
+    uint64_t old_size = 0;
+    time_t start_time = 0;
+    time_t old_end_time = 0;
+    bool known = lookup_recording_usage(id, stream_name, sizeof(stream_name), &old_size,
+                                        &start_time, &old_end_time) == 0;
+    
+    stmt = get_cached_stmt(DB_STMT_RECORDING_UPDATE, RECORDING_UPDATE_SQL);
+    if (!stmt) {
+        return -1;
+    }
     
     // Bind parameters
     sqlite3_bind_int64(stmt, 1, (sqlite3_int64)end_time);
@@ -119,24 +243,26 @@ int update_recording_metadata(uint64_t id, time_t end_time,
     rc = sqlite3_step(stmt);
     if (rc != SQLITE_DONE) {
         log_error("Failed to update recording metadata: %s", sqlite3_errmsg(db));
-        sqlite3_finalize(stmt);
-        pthread_mutex_unlock(db_mutex);
+        release_cached_stmt(stmt);
         return -1;
     }
     
-    // Finalize the prepared statement
-    sqlite3_finalize(stmt);
-    pthread_mutex_unlock(db_mutex);
+    // Hand back the cached statement
+    release_cached_stmt(stmt);
+    if (known) {
+        recording_usage_resize(stream_name, (int64_t)size_bytes - (int64_t)old_size, start_time,
+                               end_time > old_end_time ? end_time : old_end_time);
+    }
     
     return 0;
 }
 
-// Get recording metadata by ID
-int get_recording_metadata_by_id(uint64_t id, recording_metadata_t *metadata) {
-    int rc;
-    sqlite3_stmt *stmt;
-    int result = -1;
-    
+/**
+ * Write one update of a recording in its own statement
+ * Used when the writer thread is not running or holds no free slot.
+ */
+static int write_recording_update(uint64_t id, time_t end_time,
+                                  uint64_t size_bytes, bool is_complete) {
     sqlite3 *db = get_db_handle();
     pthread_mutex_t *db_mutex = get_db_mutex();
     
@@ -145,90 +271,209 @@ int get_recording_metadata_by_id(uint64_t id, recording_metadata_t *metadata) {
         return -1;
     }
     
-    if (!metadata) {
-        log_error("Invalid parameters for get_recording_metadata_by_id");
+    lock_db_mutex();
+    int rc = apply_recording_update(db, id, end_time, size_bytes, is_complete);
+    pthread_mutex_unlock(db_mutex);
+    
+    return rc;
+}
+
+/**
+ * Write a batch of updates in one transaction
+ */
+static int write_recording_updates(const pending_recording_update_t *updates, int count) {
+    sqlite3 *db = get_db_handle();
+    pthread_mutex_t *db_mutex = get_db_mutex();
+    
+    if (!db) {
+        log_error("Database not initialized");
         return -1;
     }
     
-    pthread_mutex_lock(db_mutex);
-    
-    const char *sql = "SELECT id, stream_name, file_path, start_time, end_time, "
-                      "size_bytes, width, height, fps, codec, is_complete "
-                      "FROM recordings WHERE id = ?;";
+    lock_db_mutex();
     
-    rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
-        log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+    char *err_msg = NULL;
+    if (sqlite3_exec(db, "BEGIN TRANSACTION;", NULL, NULL, &err_msg) != SQLITE_OK) {
+        log_error("Failed to begin transaction: %s", err_msg);
+        sqlite3_free(err_msg);
         pthread_mutex_unlock(db_mutex);
         return -1;
     }
     
-    // No longer tracking statements - each function is responsible for finalizing its own statements
+    // A recording deleted meanwhile updates no row and is skipped
+    for (int i = 0; i < count; i++) {
+        if (apply_recording_update(db, updates[i].id, updates[i].end_time,
+                                   updates[i].size_bytes, updates[i].is_complete) != 0) {
+            sqlite3_exec(db, "ROLLBACK;", NULL, NULL, NULL);
+            pthread_mutex_unlock(db_mutex);
+            return -1;
+        }
+    }
     
-    // Bind parameters
-    sqlite3_bind_int64(stmt, 1, (sqlite3_int64)id);
+    if (sqlite3_exec(db, "COMMIT;", NULL, NULL, &err_msg) != SQLITE_OK) {
+        log_error("Failed to commit transaction: %s", err_msg);
+        sqlite3_free(err_msg);
+        sqlite3_exec(db, "ROLLBACK;", NULL, NULL, NULL);
+        pthread_mutex_unlock(db_mutex);
+        return -1;
+    }
     
-    // Execute query and fetch result
-    if (sqlite3_step(stmt) == SQLITE_ROW) {
-        metadata->id = (uint64_t)sqlite3_column_int64(stmt, 0);
-        
-        const char *stream = (const char *)sqlite3_column_text(stmt, 1);
-        if (stream) {
-            strncpy(metadata->stream_name, stream, sizeof(metadata->stream_name) - 1);
-            metadata->stream_name[sizeof(metadata->stream_name) - 1] = '\0';
-        } else {
-            metadata->stream_name[0] = '\0';
+    pthread_mutex_unlock(db_mutex);
+    return 0;
+}
+
+/**
+ * Forget the pending update of a recording
+ * For writes that replace what the update would set. Must be called with
+ * the updates mutex held.
+ */
+static void drop_pending_update(uint64_t id) {
+    for (int i = 0; i < pending_count; i++) {
+        if (pending_updates[i].id == id) {
+            pending_updates[i] = pending_updates[--pending_count];
+            return;
         }
-        
-        const char *path = (const char *)sqlite3_column_text(stmt, 2);
-        if (path) {
-            strncpy(metadata->file_path, path, sizeof(metadata->file_path) - 1);
-            metadata->file_path[sizeof(metadata->file_path) - 1] = '\0';
-        } else {
-            metadata->file_path[0] = '\0';
+    }
+}
+
+/**
+ * Writer thread
+ * Writes the latest update of each recording once per flush interval, or
+ * as soon as a finalization is waiting.
+ */
+static void *recording_update_writer_func(void *arg) {
+    (void)arg;
+    pthread_setname_np(pthread_self(), "db-recordings");
+
+    pthread_mutex_lock(&updates_mutex);
+    while (update_writer_running || pending_count > 0) {
+        if (update_writer_running && !flush_now) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += (long)RECORDING_UPDATE_FLUSH_MS * 1000000L;
+            deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+            deadline.tv_nsec %= 1000000000L;
+            pthread_cond_timedwait(&updates_cond, &updates_mutex, &deadline);
         }
-        
-        metadata->start_time = (time_t)sqlite3_column_int64(stmt, 3);
-        
-        if (sqlite3_column_type(stmt, 4) != SQLITE_NULL) {
-            metadata->end_time = (time_t)sqlite3_column_int64(stmt, 4);
-        } else {
-            metadata->end_time = 0;
+        flush_now = false;
+
+        // Updates queued from here on go into the next batch
+        int count = pending_count;
+        memcpy(writer_updates, pending_updates, (size_t)count * sizeof(writer_updates[0]));
+        pending_count = 0;
+        uint64_t generation = update_generation++;
+
+        if (count > 0) {
+            pthread_mutex_unlock(&updates_mutex);
+            bool written = write_recording_updates(writer_updates, count) == 0;
+            if (written) {
+                log_debug("Stored a batch of %d recording updates", count);
+            } else {
+                log_error("Failed to store a batch of %d recording updates", count);
+            }
+            pthread_mutex_lock(&updates_mutex);
+            if (!written) {
+                failed_generation = generation;
+            }
         }
-        
-        metadata->size_bytes = (uint64_t)sqlite3_column_int64(stmt, 5);
-        metadata->width = sqlite3_column_int(stmt, 6);
-        metadata->height = sqlite3_column_int(stmt, 7);
-        metadata->fps = sqlite3_column_int(stmt, 8);
-        
-        const char *codec = (const char *)sqlite3_column_text(stmt, 9);
-        if (codec) {
-            strncpy(metadata->codec, codec, sizeof(metadata->codec) - 1);
-            metadata->codec[sizeof(metadata->codec) - 1] = '\0';
-        } else {
-            metadata->codec[0] = '\0';
+
+        flushed_generation = generation;
+        pthread_cond_broadcast(&flushed_cond);
+    }
+    pthread_mutex_unlock(&updates_mutex);
+
+    return NULL;
+}
+
+int init_recording_update_writer(void) {
+    pthread_mutex_lock(&updates_mutex);
+    if (update_writer_running) {
+        pthread_mutex_unlock(&updates_mutex);
+        return 0;
+    }
+
+    pending_count = 0;
+    flush_now = false;
+    update_writer_running = true;
+
+    if (pthread_create(&update_writer_thread, NULL, recording_update_writer_func, NULL) != 0) {
+        log_error("Failed to start recording update writer thread");
+        update_writer_running = false;
+        pthread_mutex_unlock(&updates_mutex);
+        return -1;
+    }
+    pthread_mutex_unlock(&updates_mutex);
+
+    log_info("Recording update writer started (every %d ms)", RECORDING_UPDATE_FLUSH_MS);
+    return 0;
+}
+
+void shutdown_recording_update_writer(void) {
+    pthread_mutex_lock(&updates_mutex);
+    if (!update_writer_running) {
+        pthread_mutex_unlock(&updates_mutex);
+        return;
+    }
+    update_writer_running = false;
+    pthread_cond_signal(&updates_cond);
+    pthread_mutex_unlock(&updates_mutex);
+
+    // The thread writes what is still pending before it exits
+    pthread_join(update_writer_thread, NULL);
+
+    log_info("Recording update writer stopped");
+}
+
+// Update recording metadata in the database
+int update_recording_metadata(uint64_t id, time_t end_time, 
+                             uint64_t size_bytes, bool is_complete) {
+    pthread_mutex_lock(&updates_mutex);
+    if (!update_writer_running) {
+        pthread_mutex_unlock(&updates_mutex);
+        return write_recording_update(id, end_time, size_bytes, is_complete);
+    }
+    
+    // Each update sets every column, so only the latest one of a recording is kept
+    pending_recording_update_t *update = NULL;
+    for (int i = 0; i < pending_count; i++) {
+        if (pending_updates[i].id == id) {
+            update = &pending_updates[i];
+            break;
         }
-        
-        metadata->is_complete = sqlite3_column_int(stmt, 10) != 0;
-        
-        result = 0; // Success
     }
+    if (!update) {
+        if (pending_count == RECORDING_UPDATE_SLOTS) {
+            pthread_mutex_unlock(&updates_mutex);
+            return write_recording_update(id, end_time, size_bytes, is_complete);
+        }
+        update = &pending_updates[pending_count++];
+    }
+    update->id = id;
+    update->end_time = end_time;
+    update->size_bytes = size_bytes;
+    update->is_complete = is_complete;
     
-    // Finalize the prepared statement
-    sqlite3_finalize(stmt);
-    pthread_mutex_unlock(db_mutex);
+    if (!is_complete) {
+        pthread_mutex_unlock(&updates_mutex);
+        return 0;
+    }
     
-    return result;
+    // A finalization is written right away, together with whatever else is
+    // pending, and waited for so callers read the finished row
+    uint64_t generation = update_generation;
+    flush_now = true;
+    pthread_cond_signal(&updates_cond);
+    while (flushed_generation < generation) {
+        pthread_cond_wait(&flushed_cond, &updates_mutex);
+    }
+    int rc = failed_generation == generation ? -1 : 0;
+    pthread_mutex_unlock(&updates_mutex);
+    
+    return rc;
 }
 
-// Get recording metadata from the database
-int get_recording_metadata(time_t start_time, time_t end_time, 
-                          const char *stream_name, recording_metadata_t *metadata, 
-                          int max_count) {
-    int rc;
-    sqlite3_stmt *stmt;
-    int count = 0;
-    
+// Add a segment to a recording kept as HLS segments
+int add_recording_segment(uint64_t recording_id, const recording_segment_t *segment, time_t end_time) {
     sqlite3 *db = get_db_handle();
     pthread_mutex_t *db_mutex = get_db_mutex();
     
@@ -237,43 +482,354 @@ int get_recording_metadata(time_t start_time, time_t end_time,
         return -1;
     }
     
-    if (!metadata || max_count <= 0) {
-        log_error("Invalid parameters for get_recording_metadata");
+    if (!segment) {
+        log_error("Recording segment is required");
         return -1;
     }
     
-    pthread_mutex_lock(db_mutex);
+    // The segment sets size and end time from the row, which a pending update must not overwrite
+    pthread_mutex_lock(&updates_mutex);
+    drop_pending_update(recording_id);
+    pthread_mutex_unlock(&updates_mutex);
     
-    // Build query based on filters
-    char sql[1024];
-    strcpy(sql, "SELECT id, stream_name, file_path, start_time, end_time, "
-                 "size_bytes, width, height, fps, codec, is_complete "
-                 "FROM recordings WHERE is_complete = 1 AND end_time IS NOT NULL"); // Only complete recordings with end_time set
+    lock_db_mutex();
     
-    if (start_time > 0) {
-        strcat(sql, " AND start_time >= ?");
+    char stream_name[64];
+    uint64_t old_size = 0;
+    time_t start_time = 0;
+    time_t old_end_time = 0;
+    if (lookup_recording_usage(recording_id, stream_name, sizeof(stream_name), &old_size,
+                               &start_time, &old_end_time) != 0) {
+        // Deleted while it was being written
+        pthread_mutex_unlock(db_mutex);
+        return -1;
     }
     
-    if (end_time > 0) {
-        strcat(sql, " AND start_time <= ?");
+    // One commit for the segment and its recording
+    char *err_msg = NULL;
+    if (sqlite3_exec(db, "BEGIN TRANSACTION;", NULL, NULL, &err_msg) != SQLITE_OK) {
+        log_error("Failed to begin transaction: %s", err_msg);
+        sqlite3_free(err_msg);
+        pthread_mutex_unlock(db_mutex);
+        return -1;
     }
     
-    if (stream_name) {
-        strcat(sql, " AND stream_name = ?");
+    int rc = SQLITE_ERROR;
+    sqlite3_stmt *stmt = get_cached_stmt(DB_STMT_RECORDING_SEGMENT_INSERT,
+                                         "INSERT OR REPLACE INTO recording_segments (recording_id, sequence, "
+                                         "file_name, start_ms, duration_ms, size_bytes) "
+                                         "VALUES (?, ?, ?, ?, ?, ?);");
+    if (stmt) {
+        sqlite3_bind_int64(stmt, 1, (sqlite3_int64)recording_id);
+        sqlite3_bind_int(stmt, 2, segment->sequence);
+        sqlite3_bind_text(stmt, 3, segment->file_name, -1, SQLITE_STATIC);
+        sqlite3_bind_int64(stmt, 4, (sqlite3_int64)segment->start_ms);
+        sqlite3_bind_int64(stmt, 5, (sqlite3_int64)segment->duration_ms);
+        sqlite3_bind_int64(stmt, 6, (sqlite3_int64)segment->size_bytes);
+        rc = sqlite3_step(stmt);
+        release_cached_stmt(stmt);
     }
     
-    strcat(sql, " ORDER BY start_time DESC LIMIT ?;");
+    uint64_t size_bytes = old_size + segment->size_bytes;
+    if (rc == SQLITE_DONE) {
+        stmt = get_cached_stmt(DB_STMT_RECORDING_UPDATE, RECORDING_UPDATE_SQL);
+        rc = SQLITE_ERROR;
+        if (stmt) {
+            sqlite3_bind_int64(stmt, 1, (sqlite3_int64)end_time);
+            sqlite3_bind_int64(stmt, 2, (sqlite3_int64)size_bytes);
+            sqlite3_bind_int(stmt, 3, 0);
+            sqlite3_bind_int64(stmt, 4, (sqlite3_int64)recording_id);
+            rc = sqlite3_step(stmt);
+            release_cached_stmt(stmt);
+        }
+    }
     
-    rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
-        log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+    if (rc != SQLITE_DONE) {
+        log_error("Failed to add recording segment: %s", sqlite3_errmsg(db));
+        sqlite3_exec(db, "ROLLBACK;", NULL, NULL, NULL);
         pthread_mutex_unlock(db_mutex);
         return -1;
     }
     
-    // No longer tracking statements - each function is responsible for finalizing its own statements
+    if (sqlite3_exec(db, "COMMIT;", NULL, NULL, &err_msg) != SQLITE_OK) {
+        log_error("Failed to commit recording segment: %s", err_msg);
+        sqlite3_free(err_msg);
+        sqlite3_exec(db, "ROLLBACK;", NULL, NULL, NULL);
+        pthread_mutex_unlock(db_mutex);
+        return -1;
+    }
     
-    // Bind parameters
+    recording_usage_resize(stream_name, (int64_t)segment->size_bytes, start_time,
+                           end_time > old_end_time ? end_time : old_end_time);
+    pthread_mutex_unlock(db_mutex);
+    
+    return 0;
+}
+
+// Get the segments of a recording kept as HLS segments
+int get_recording_segments(uint64_t recording_id, recording_segment_t **segments) {
+    if (!segments) {
+        return -1;
+    }
+    *segments = NULL;
+    
+    sqlite3 *db = acquire_db_reader();
+    if (!db) {
+        log_error("Database not initialized");
+        return -1;
+    }
+    
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, "SELECT sequence, file_name, start_ms, duration_ms, size_bytes "
+                               "FROM recording_segments WHERE recording_id = ? ORDER BY sequence;",
+                           -1, &stmt, NULL) != SQLITE_OK) {
+        log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+        release_db_reader(db);
+        return -1;
+    }
+    
+    sqlite3_bind_int64(stmt, 1, (sqlite3_int64)recording_id);
+    
+    int count = 0;
+    int capacity = 0;
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            recording_segment_t *grown = realloc(*segments, (size_t)capacity * sizeof(recording_segment_t));
+            if (!grown) {
+                rc = SQLITE_NOMEM;
+                break;
+            }
+            *segments = grown;
+        }
+        
+        recording_segment_t *segment = &(*segments)[count++];
+        memset(segment, 0, sizeof(*segment));
+        segment->sequence = sqlite3_column_int(stmt, 0);
+        const char *name = (const char *)sqlite3_column_text(stmt, 1);
+        strncpy(segment->file_name, name ? name : "", sizeof(segment->file_name) - 1);
+        segment->start_ms = sqlite3_column_int64(stmt, 2);
+        segment->duration_ms = sqlite3_column_int64(stmt, 3);
+        segment->size_bytes = (uint64_t)sqlite3_column_int64(stmt, 4);
+    }
+    
+    if (rc != SQLITE_DONE) {
+        log_error("Failed to get segments of recording %llu: %s", (unsigned long long)recording_id,
+                  sqlite3_errmsg(db));
+        free(*segments);
+        *segments = NULL;
+        count = -1;
+    }
+    
+    sqlite3_finalize(stmt);
+    release_db_reader(db);
+    
+    return count;
+}
+
+// Get recording metadata by ID
+int get_recording_metadata_by_id(uint64_t id, recording_metadata_t *metadata) {
+    sqlite3_stmt *stmt;
+    int result = -1;
+    
+    sqlite3 *db = get_db_handle();
+    pthread_mutex_t *db_mutex = get_db_mutex();
+    
+    if (!db) {
+        log_error("Database not initialized");
+        return -1;
+    }
+    
+    if (!metadata) {
+        log_error("Invalid parameters for get_recording_metadata_by_id");
+        return -1;
+    }
+    
+    lock_db_mutex();
+    
+    const char *sql = "SELECT id, stream_name, file_path, start_time, end_time, "
+                      "size_bytes, width, height, fps, codec, is_complete "
+                      "FROM recordings WHERE id = ?;";
+    
+    stmt = get_cached_stmt(DB_STMT_RECORDING_BY_ID, sql);
+    if (!stmt) {
+        pthread_mutex_unlock(db_mutex);
+        return -1;
+    }
+    
+    // Bind parameters
+    sqlite3_bind_int64(stmt, 1, (sqlite3_int64)id);
+    
+    // Execute query and fetch result
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        metadata->id = (uint64_t)sqlite3_column_int64(stmt, 0);
+        
+        const char *stream = (const char *)sqlite3_column_text(stmt, 1);
+        if (stream) {
+            strncpy(metadata->stream_name, stream, sizeof(metadata->stream_name) - 1);
+            metadata->stream_name[sizeof(metadata->stream_name) - 1] = '\0';
+        } else {
+            metadata->stream_name[0] = '\0';
+        }
+        
+        const char *path = (const char *)sqlite3_column_text(stmt, 2);
+        if (path) {
+            strncpy(metadata->file_path, path, sizeof(metadata->file_path) - 1);
+            metadata->file_path[sizeof(metadata->file_path) - 1] = '\0';
+        } else {
+            metadata->file_path[0] = '\0';
+        }
+        
+        metadata->start_time = (time_t)sqlite3_column_int64(stmt, 3);
+        
+        if (sqlite3_column_type(stmt, 4) != SQLITE_NULL) {
+            metadata->end_time = (time_t)sqlite3_column_int64(stmt, 4);
+        } else {
+            metadata->end_time = 0;
+        }
+        
+        metadata->size_bytes = (uint64_t)sqlite3_column_int64(stmt, 5);
+        metadata->width = sqlite3_column_int(stmt, 6);
+        metadata->height = sqlite3_column_int(stmt, 7);
+        metadata->fps = sqlite3_column_int(stmt, 8);
+        
+        const char *codec = (const char *)sqlite3_column_text(stmt, 9);
+        if (codec) {
+            strncpy(metadata->codec, codec, sizeof(metadata->codec) - 1);
+            metadata->codec[sizeof(metadata->codec) - 1] = '\0';
+        } else {
+            metadata->codec[0] = '\0';
+        }
+        
+        metadata->is_complete = sqlite3_column_int(stmt, 10) != 0;
+        
+        result = 0; // Success
+    }
+    
+    // Hand back the cached statement
+    release_cached_stmt(stmt);
+    pthread_mutex_unlock(db_mutex);
+    
+    return result;
+}
+
+// Get recordings that were never marked complete
+int get_incomplete_recordings(recording_metadata_t *metadata, int max_count) {
+    int rc;
+    sqlite3_stmt *stmt;
+    int count = 0;
+    
+    sqlite3 *db = get_db_handle();
+    pthread_mutex_t *db_mutex = get_db_mutex();
+    
+    if (!db) {
+        log_error("Database not initialized");
+        return -1;
+    }
+    
+    if (!metadata || max_count <= 0) {
+        log_error("Invalid parameters for get_incomplete_recordings");
+        return -1;
+    }
+    
+    lock_db_mutex();
+    
+    // Uses the is_complete index, so complete recordings are never scanned
+    const char *sql = "SELECT id, stream_name, file_path, start_time "
+                      "FROM recordings WHERE is_complete = 0 ORDER BY start_time LIMIT ?;";
+    
+    rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+    if (rc != SQLITE_OK) {
+        log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+        pthread_mutex_unlock(db_mutex);
+        return -1;
+    }
+    
+    sqlite3_bind_int(stmt, 1, max_count);
+    
+    while (count < max_count && sqlite3_step(stmt) == SQLITE_ROW) {
+        recording_metadata_t *entry = &metadata[count];
+        memset(entry, 0, sizeof(recording_metadata_t));
+        entry->id = (uint64_t)sqlite3_column_int64(stmt, 0);
+        
+        const char *stream = (const char *)sqlite3_column_text(stmt, 1);
+        if (stream) {
+            strncpy(entry->stream_name, stream, sizeof(entry->stream_name) - 1);
+        }
+        
+        const char *path = (const char *)sqlite3_column_text(stmt, 2);
+        if (path) {
+            strncpy(entry->file_path, path, sizeof(entry->file_path) - 1);
+        }
+        
+        entry->start_time = (time_t)sqlite3_column_int64(stmt, 3);
+        count++;
+    }
+    
+    sqlite3_finalize(stmt);
+    pthread_mutex_unlock(db_mutex);
+    
+    return count;
+}
+
+// Get recording metadata from the database
+int get_recording_metadata(time_t start_time, time_t end_time, 
+                          const char *stream_name, recording_metadata_t *metadata, 
+                          int max_count) {
+    int rc;
+    sqlite3_stmt *stmt;
+    int count = 0;
+    
+    sqlite3 *db = get_db_handle();
+    
+    if (!db) {
+        log_error("Database not initialized");
+        return -1;
+    }
+    
+    if (!metadata || max_count <= 0) {
+        log_error("Invalid parameters for get_recording_metadata");
+        return -1;
+    }
+    
+    // Listing queries run on a reader connection and never wait for the writer
+    db = acquire_db_reader();
+    if (!db) {
+        log_error("Database not initialized");
+        return -1;
+    }
+    
+    // Build query based on filters
+    char sql[1024];
+    strcpy(sql, "SELECT id, stream_name, file_path, start_time, end_time, "
+                 "size_bytes, width, height, fps, codec, is_complete "
+                 "FROM recordings WHERE is_complete = 1 AND end_time IS NOT NULL"); // Only complete recordings with end_time set
+    
+    if (start_time > 0) {
+        strcat(sql, " AND start_time >= ?");
+    }
+    
+    if (end_time > 0) {
+        strcat(sql, " AND start_time <= ?");
+    }
+    
+    if (stream_name) {
+        strcat(sql, " AND stream_id = " STREAM_ID_OF("?"));
+    }
+    
+    strcat(sql, " ORDER BY start_time DESC LIMIT ?;");
+    
+    rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+    if (rc != SQLITE_OK) {
+        log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+        release_db_reader(db);
+        return -1;
+    }
+    
+    // No longer tracking statements - each function is responsible for finalizing its own statements
+    
+    // Bind parameters
     int param_index = 1;
     
     if (start_time > 0) {
@@ -346,12 +902,83 @@ int get_recording_metadata(time_t start_time, time_t end_time,
     
     // Finalize the prepared statement
     sqlite3_finalize(stmt);
-    pthread_mutex_unlock(db_mutex);
+    release_db_reader(db);
     
     log_info("Found %d recordings in database matching criteria", count);
     return count;
 }
 
+/**
+ * Count recordings from the per-day counts of recording_days
+ * Days the range covers whole are summed from recording_days, and only the
+ * partial days at its edges are counted in recordings, so the cost does
+ * not grow with the width of the range.
+ *
+ * @return Number of recordings, or -1 if recording_days cannot be read
+ */
+static int count_recordings_by_day(sqlite3 *db, time_t start_time, time_t end_time,
+                                   const char *stream_name) {
+    const sqlite3_int64 day_seconds = 86400;
+    sqlite3_int64 lo = start_time > 0 ? (sqlite3_int64)start_time : 0;
+    sqlite3_int64 first_day = (lo + day_seconds - 1) / day_seconds;
+    sqlite3_int64 last_day;
+    sqlite3_int64 head_end = first_day * day_seconds - 1;
+    sqlite3_int64 tail_start, tail_end;
+
+    if (end_time > 0) {
+        sqlite3_int64 hi = (sqlite3_int64)end_time;
+        last_day = (hi + 1) / day_seconds - 1;
+        tail_start = (last_day + 1) * day_seconds;
+        tail_end = hi;
+        if (first_day > last_day) {
+            // No whole day in the range: count all of it directly
+            head_end = hi;
+            tail_start = 1;
+            tail_end = 0;
+        }
+    } else {
+        last_day = INT32_MAX;
+        tail_start = 1;
+        tail_end = 0;
+    }
+
+    char sql[1024];
+    snprintf(sql, sizeof(sql),
+             "SELECT (SELECT COALESCE(SUM(count), 0) FROM recording_days WHERE day BETWEEN ?1 AND ?2%s)"
+             " + (SELECT COUNT(*) FROM recordings WHERE is_complete = 1 AND end_time IS NOT NULL"
+             " AND start_time BETWEEN ?3 AND ?4%s)"
+             " + (SELECT COUNT(*) FROM recordings WHERE is_complete = 1 AND end_time IS NOT NULL"
+             " AND start_time BETWEEN ?5 AND ?6%s)",
+             stream_name ? " AND stream_id = " STREAM_ID_OF("?7") : "",
+             stream_name ? " AND stream_id = " STREAM_ID_OF("?7") : "",
+             stream_name ? " AND stream_id = " STREAM_ID_OF("?7") : "");
+
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        log_warn("Failed to prepare recording day count: %s", sqlite3_errmsg(db));
+        return -1;
+    }
+
+    sqlite3_bind_int64(stmt, 1, first_day);
+    sqlite3_bind_int64(stmt, 2, last_day);
+    sqlite3_bind_int64(stmt, 3, lo);
+    sqlite3_bind_int64(stmt, 4, head_end);
+    sqlite3_bind_int64(stmt, 5, tail_start);
+    sqlite3_bind_int64(stmt, 6, tail_end);
+    if (stream_name) {
+        sqlite3_bind_text(stmt, 7, stream_name, -1, SQLITE_STATIC);
+    }
+
+    int count = -1;
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        count = sqlite3_column_int(stmt, 0);
+    } else {
+        log_warn("Failed to count recordings by day: %s", sqlite3_errmsg(db));
+    }
+    sqlite3_finalize(stmt);
+    return count;
+}
+
 // Get total count of recordings matching filter criteria
 int get_recording_count(time_t start_time, time_t end_time, 
                        const char *stream_name, int has_detection) {
@@ -360,23 +987,33 @@ int get_recording_count(time_t start_time, time_t end_time,
     int count = 0;
     
     sqlite3 *db = get_db_handle();
-    pthread_mutex_t *db_mutex = get_db_mutex();
     
     if (!db) {
         log_error("Database not initialized");
         return -1;
     }
     
-    pthread_mutex_lock(db_mutex);
+    db = acquire_db_reader();
+    if (!db) {
+        log_error("Database not initialized");
+        return -1;
+    }
+    
+    // Without a detection filter the count comes from the per-day counts
+    if (!has_detection) {
+        count = count_recordings_by_day(db, start_time, end_time, stream_name);
+        if (count >= 0) {
+            release_db_reader(db);
+            return count;
+        }
+        count = 0;
+    }
     
     // Build query based on filters
     char sql[1024];
     
     if (has_detection) {
-        // Use a JOIN with the detections table to filter recordings with detections
-        strcpy(sql, "SELECT COUNT(DISTINCT r.id) FROM recordings r "
-                    "INNER JOIN detections d ON r.stream_name = d.stream_name "
-                    "WHERE d.timestamp BETWEEN r.start_time AND COALESCE(r.end_time, strftime('%s', 'now')) "
+        strcpy(sql, "SELECT COUNT(*) FROM recordings r WHERE " HAS_DETECTION_FILTER " "
                     "AND r.is_complete = 1 AND r.end_time IS NOT NULL");
     } else {
         // Simple query without detection filter
@@ -395,9 +1032,9 @@ int get_recording_count(time_t start_time, time_t end_time,
     
     if (stream_name) {
         if (has_detection) {
-            strcat(sql, " AND r.stream_name = ?");
+            strcat(sql, " AND r.stream_id = " STREAM_ID_OF("?"));
         } else {
-            strcat(sql, " AND stream_name = ?");
+            strcat(sql, " AND stream_id = " STREAM_ID_OF("?"));
         }
     }
     
@@ -406,7 +1043,7 @@ int get_recording_count(time_t start_time, time_t end_time,
     rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
     if (rc != SQLITE_OK) {
         log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
-        pthread_mutex_unlock(db_mutex);
+        release_db_reader(db);
         return -1;
     }
     
@@ -437,24 +1074,28 @@ int get_recording_count(time_t start_time, time_t end_time,
     
     // Finalize the prepared statement
     sqlite3_finalize(stmt);
-    pthread_mutex_unlock(db_mutex);
+    release_db_reader(db);
     
     log_info("Total count of recordings matching criteria: %d", count);
     return count;
 }
 
-// Get paginated recording metadata from the database with sorting
-int get_recording_metadata_paginated(time_t start_time, time_t end_time, 
-                                   const char *stream_name, int has_detection,
-                                   const char *sort_field, const char *sort_order,
-                                   recording_metadata_t *metadata, 
-                                   int limit, int offset) {
+/**
+ * Get one page of recordings, either after a cursor or at an offset
+ * With a cursor the page is ordered by (start_time, id) and starts right
+ * after the cursor row, so deep pages cost the same as the first one.
+ */
+static int query_recording_page(time_t start_time, time_t end_time,
+                                const char *stream_name, int has_detection,
+                                const char *sort_field, const char *sort_order,
+                                const recording_cursor_t *cursor,
+                                recording_metadata_t *metadata,
+                                int limit, int offset) {
     int rc;
     sqlite3_stmt *stmt;
     int count = 0;
     
     sqlite3 *db = get_db_handle();
-    pthread_mutex_t *db_mutex = get_db_mutex();
     
     if (!db) {
         log_error("Database not initialized");
@@ -466,11 +1107,15 @@ int get_recording_metadata_paginated(time_t start_time, time_t end_time,
         return -1;
     }
     
-    pthread_mutex_lock(db_mutex);
-    
-    // Validate and sanitize sort field to prevent SQL injection
-    char safe_sort_field[32] = "start_time"; // Default sort field
-    if (sort_field) {
+    db = acquire_db_reader();
+    if (!db) {
+        log_error("Database not initialized");
+        return -1;
+    }
+    
+    // Validate and sanitize sort field to prevent SQL injection
+    char safe_sort_field[32] = "start_time"; // Default sort field
+    if (sort_field && !cursor) {
         if (strcmp(sort_field, "id") == 0 ||
             strcmp(sort_field, "stream_name") == 0 ||
             strcmp(sort_field, "start_time") == 0 ||
@@ -499,13 +1144,10 @@ int get_recording_metadata_paginated(time_t start_time, time_t end_time,
     char sql[1024];
     
     if (has_detection) {
-        // Use a JOIN with the detections table to filter recordings with detections
         snprintf(sql, sizeof(sql), 
-                "SELECT DISTINCT r.id, r.stream_name, r.file_path, r.start_time, r.end_time, "
+                "SELECT r.id, r.stream_name, r.file_path, r.start_time, r.end_time, "
                 "r.size_bytes, r.width, r.height, r.fps, r.codec, r.is_complete "
-                "FROM recordings r "
-                "INNER JOIN detections d ON r.stream_name = d.stream_name "
-                "WHERE d.timestamp BETWEEN r.start_time AND COALESCE(r.end_time, strftime('%%s', 'now')) "
+                "FROM recordings r WHERE " HAS_DETECTION_FILTER " "
                 "AND r.is_complete = 1 AND r.end_time IS NOT NULL");
     } else {
         // Simple query without detection filter
@@ -535,32 +1177,38 @@ int get_recording_metadata_paginated(time_t start_time, time_t end_time,
     
     if (stream_name) {
         if (has_detection) {
-            strcat(sql, " AND r.stream_name = ?");
+            strcat(sql, " AND r.stream_id = " STREAM_ID_OF("?"));
         } else {
-            strcat(sql, " AND stream_name = ?");
+            strcat(sql, " AND stream_id = " STREAM_ID_OF("?"));
         }
     }
     
-    // Add ORDER BY clause with sanitized field and order
-    char order_clause[64];
-    if (has_detection) {
-        snprintf(order_clause, sizeof(order_clause), " ORDER BY r.%s %s", safe_sort_field, safe_sort_order);
-    } else {
-        snprintf(order_clause, sizeof(order_clause), " ORDER BY %s %s", safe_sort_field, safe_sort_order);
+    // Rows after the cursor in (start_time, id) order
+    const char *prefix = has_detection ? "r." : "";
+    bool ascending = strcmp(safe_sort_order, "ASC") == 0;
+    if (cursor) {
+        char cursor_clause[128];
+        snprintf(cursor_clause, sizeof(cursor_clause),
+                 " AND (%sstart_time %c ? OR (%sstart_time = ? AND %sid %c ?))",
+                 prefix, ascending ? '>' : '<', prefix, prefix, ascending ? '>' : '<');
+        strcat(sql, cursor_clause);
     }
+    
+    // Add ORDER BY clause with sanitized field and order, id keeps equal values in a stable order
+    char order_clause[96];
+    snprintf(order_clause, sizeof(order_clause), " ORDER BY %s%s %s, %sid %s",
+             prefix, safe_sort_field, safe_sort_order, prefix, safe_sort_order);
     strcat(sql, order_clause);
     
     // Add LIMIT and OFFSET for pagination
-    char limit_clause[64];
-    snprintf(limit_clause, sizeof(limit_clause), " LIMIT ? OFFSET ?");
-    strcat(sql, limit_clause);
+    strcat(sql, cursor ? " LIMIT ?" : " LIMIT ? OFFSET ?");
     
     log_info("SQL query for get_recording_metadata_paginated: %s", sql);
     
     rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
     if (rc != SQLITE_OK) {
         log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
-        pthread_mutex_unlock(db_mutex);
+        release_db_reader(db);
         return -1;
     }
     
@@ -581,9 +1229,17 @@ int get_recording_metadata_paginated(time_t start_time, time_t end_time,
         sqlite3_bind_text(stmt, param_index++, stream_name, -1, SQLITE_STATIC);
     }
     
+    if (cursor) {
+        sqlite3_bind_int64(stmt, param_index++, (sqlite3_int64)cursor->start_time);
+        sqlite3_bind_int64(stmt, param_index++, (sqlite3_int64)cursor->start_time);
+        sqlite3_bind_int64(stmt, param_index++, (sqlite3_int64)cursor->id);
+    }
+    
     // Bind LIMIT and OFFSET parameters
     sqlite3_bind_int(stmt, param_index++, limit);
-    sqlite3_bind_int(stmt, param_index, offset);
+    if (!cursor) {
+        sqlite3_bind_int(stmt, param_index, offset);
+    }
     
     // Execute query and fetch results
     int rc_step;
@@ -641,10 +1297,167 @@ int get_recording_metadata_paginated(time_t start_time, time_t end_time,
     
     // Finalize the prepared statement
     sqlite3_finalize(stmt);
-    pthread_mutex_unlock(db_mutex);
+    release_db_reader(db);
     
-    log_info("Found %d recordings in database matching criteria (page %d, limit %d)", 
-             count, (offset / limit) + 1, limit);
+    if (cursor) {
+        log_info("Found %d recordings in database matching criteria (after cursor, limit %d)", count, limit);
+    } else {
+        log_info("Found %d recordings in database matching criteria (page %d, limit %d)", 
+                 count, (offset / limit) + 1, limit);
+    }
+    return count;
+}
+
+// Get paginated recording metadata from the database with sorting
+int get_recording_metadata_paginated(time_t start_time, time_t end_time, 
+                                   const char *stream_name, int has_detection,
+                                   const char *sort_field, const char *sort_order,
+                                   recording_metadata_t *metadata, 
+                                   int limit, int offset) {
+    return query_recording_page(start_time, end_time, stream_name, has_detection,
+                                sort_field, sort_order, NULL, metadata, limit, offset);
+}
+
+// Get the page of recordings that follows a cursor
+int get_recording_metadata_after(time_t start_time, time_t end_time,
+                                 const char *stream_name, int has_detection,
+                                 const char *sort_order, const recording_cursor_t *cursor,
+                                 recording_metadata_t *metadata, int limit) {
+    if (!cursor) {
+        log_error("Cursor is required for get_recording_metadata_after");
+        return -1;
+    }
+    return query_recording_page(start_time, end_time, stream_name, has_detection,
+                                "start_time", sort_order, cursor, metadata, limit, 0);
+}
+
+// Format a cursor as a token for clients
+void format_recording_cursor(const recording_cursor_t *cursor, char *token, size_t token_size) {
+    snprintf(token, token_size, "%llx.%llx",
+             (unsigned long long)cursor->start_time, (unsigned long long)cursor->id);
+}
+
+// Parse a token from format_recording_cursor()
+int parse_recording_cursor(const char *token, recording_cursor_t *cursor) {
+    if (!token || !cursor) {
+        return -1;
+    }
+
+    // sscanf would also take signs, spaces and 0x, so the digits are read here
+    uint64_t values[2] = {0, 0};
+    const char *p = token;
+    for (int part = 0; part < 2; part++) {
+        int digits = 0;
+        for (; *p != '\0' && *p != '.'; p++, digits++) {
+            int value;
+            if (*p >= '0' && *p <= '9') {
+                value = *p - '0';
+            } else if (*p >= 'a' && *p <= 'f') {
+                value = *p - 'a' + 10;
+            } else if (*p >= 'A' && *p <= 'F') {
+                value = *p - 'A' + 10;
+            } else {
+                return -1;
+            }
+            if (digits == 16) {
+                return -1;
+            }
+            values[part] = values[part] << 4 | (uint64_t)value;
+        }
+        if (digits == 0 || values[part] > (uint64_t)INT64_MAX) {
+            return -1;
+        }
+        if (part == 0) {
+            if (*p != '.') {
+                return -1;
+            }
+            p++;
+        }
+    }
+    if (*p != '\0') {
+        return -1;
+    }
+
+    cursor->start_time = (time_t)values[0];
+    cursor->id = values[1];
+    return 0;
+}
+
+// Get the spans of the complete recordings of several streams
+int get_recording_spans(const char *streams, time_t start_time, time_t end_time,
+                        int max_spans, recording_span_t **spans) {
+    if (!streams || !spans || max_spans <= 0) {
+        log_error("Invalid parameters for get_recording_spans");
+        return -1;
+    }
+    *spans = NULL;
+
+    // The streams are looked up once, then each is a range of the index
+    const char *sql = "SELECT id, stream_name, start_time, end_time, size_bytes FROM recordings "
+                      "WHERE is_complete = 1 "
+                      "AND stream_id IN (SELECT id FROM stream_ids WHERE instr(',' || ?1 || ',', ',' || name || ',') > 0) "
+                      "AND start_time >= ?2 AND start_time <= ?3 AND end_time IS NOT NULL "
+                      "ORDER BY stream_id, start_time, id "
+                      "LIMIT ?4;";
+
+    sqlite3 *db = acquire_db_reader();
+    if (!db) {
+        log_error("Database not initialized");
+        return -1;
+    }
+
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+        release_db_reader(db);
+        return -1;
+    }
+    sqlite3_bind_text(stmt, 1, streams, -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 2, (sqlite3_int64)start_time);
+    sqlite3_bind_int64(stmt, 3, (sqlite3_int64)end_time);
+    sqlite3_bind_int(stmt, 4, max_spans);
+
+    recording_span_t *result = NULL;
+    int count = 0, capacity = 0;
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 256;
+            if (capacity > max_spans) {
+                capacity = max_spans;
+            }
+            recording_span_t *grown = realloc(result, (size_t)capacity * sizeof(recording_span_t));
+            if (!grown) {
+                log_error("Failed to allocate memory for recording spans");
+                rc = SQLITE_NOMEM;
+                break;
+            }
+            result = grown;
+        }
+
+        recording_span_t *span = &result[count++];
+        memset(span, 0, sizeof(*span));
+        span->id = (uint64_t)sqlite3_column_int64(stmt, 0);
+        const char *stream = (const char *)sqlite3_column_text(stmt, 1);
+        if (stream) {
+            strncpy(span->stream_name, stream, sizeof(span->stream_name) - 1);
+        }
+        span->start_time = (time_t)sqlite3_column_int64(stmt, 2);
+        span->end_time = (time_t)sqlite3_column_int64(stmt, 3);
+        span->size_bytes = (uint64_t)sqlite3_column_int64(stmt, 4);
+    }
+    sqlite3_finalize(stmt);
+    release_db_reader(db);
+
+    if (rc != SQLITE_DONE) {
+        if (rc != SQLITE_NOMEM) {
+            log_error("Failed to read recording spans: %s", sqlite3_errstr(rc));
+        }
+        free(result);
+        return -1;
+    }
+
+    *spans = result;
     return count;
 }
 
@@ -661,19 +1474,23 @@ int delete_recording_metadata(uint64_t id) {
         return -1;
     }
     
-    pthread_mutex_lock(db_mutex);
+    lock_db_mutex();
+    
+    char stream_name[64];
+    uint64_t size = 0;
+    time_t start_time = 0;
+    time_t end_time = 0;
+    bool known = lookup_recording_usage(id, stream_name, sizeof(stream_name), &size,
+                                        &start_time, &end_time) == 0;
     
     const char *sql = "DELETE FROM recordings WHERE id = ?;";
     
-    rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
-        log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+    stmt = get_cached_stmt(DB_STMT_RECORDING_DELETE, sql);
+    if (!stmt) {
         pthread_mutex_unlock(db_mutex);
         return -1;
     }
     
-    // No longer tracking statements - each function is responsible for finalizing its own statements
-    
     // Bind parameters
     sqlite3_bind_int64(stmt, 1, (sqlite3_int64)id);
     
@@ -681,23 +1498,25 @@ int delete_recording_metadata(uint64_t id) {
     rc = sqlite3_step(stmt);
     if (rc != SQLITE_DONE) {
         log_error("Failed to delete recording metadata: %s", sqlite3_errmsg(db));
-        sqlite3_finalize(stmt);
+        release_cached_stmt(stmt);
         pthread_mutex_unlock(db_mutex);
         return -1;
     }
     
-    // Finalize the prepared statement
-    sqlite3_finalize(stmt);
+    // Hand back the cached statement
+    release_cached_stmt(stmt);
+    if (known && sqlite3_changes(db) > 0) {
+        recording_usage_remove(stream_name, 1, size, start_time, end_time);
+    }
     pthread_mutex_unlock(db_mutex);
     
     return 0;
 }
 
-// Delete old recording metadata from the database
-int delete_old_recording_metadata(uint64_t max_age) {
+// Point a recording at a copy of its file, unless it changed meanwhile
+int move_recording_file_path(uint64_t id, const char *old_path, const char *new_path) {
     int rc;
     sqlite3_stmt *stmt;
-    int deleted_count = 0;
     
     sqlite3 *db = get_db_handle();
     pthread_mutex_t *db_mutex = get_db_mutex();
@@ -707,36 +1526,557 @@ int delete_old_recording_metadata(uint64_t max_age) {
         return -1;
     }
     
-    pthread_mutex_lock(db_mutex);
+    if (!old_path || !new_path) {
+        log_error("Old and new file paths are required");
+        return -1;
+    }
     
-    const char *sql = "DELETE FROM recordings WHERE end_time < ?;";
+    lock_db_mutex();
+    
+    // Matching the old path makes this a compare-and-swap: a recording
+    // deleted or moved while its file was copied is left as it is. The
+    // recordings compacted into the same container share the file, so
+    // they move with it, in one transaction.
+    char *err_msg = NULL;
+    if (sqlite3_exec(db, "BEGIN TRANSACTION;", NULL, NULL, &err_msg) != SQLITE_OK) {
+        log_error("Failed to begin transaction: %s", err_msg);
+        sqlite3_free(err_msg);
+        pthread_mutex_unlock(db_mutex);
+        return -1;
+    }
+    
+    const char *sql = "UPDATE recordings SET file_path = ?1 WHERE file_path = ?3 AND (id = ?2 OR id IN "
+                      "(SELECT recording_id FROM compacted_recordings WHERE container = ?3));";
     
     rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
     if (rc != SQLITE_OK) {
         log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+        sqlite3_exec(db, "ROLLBACK;", NULL, NULL, NULL);
         pthread_mutex_unlock(db_mutex);
         return -1;
     }
     
-    // Calculate cutoff time
-    time_t cutoff_time = time(NULL) - max_age;
-    
-    // Bind parameters
-    sqlite3_bind_int64(stmt, 1, (sqlite3_int64)cutoff_time);
+    sqlite3_bind_text(stmt, 1, new_path, -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 2, (sqlite3_int64)id);
+    sqlite3_bind_text(stmt, 3, old_path, -1, SQLITE_STATIC);
     
-    // Execute statement
     rc = sqlite3_step(stmt);
+    int result;
     if (rc != SQLITE_DONE) {
-        log_error("Failed to delete old recording metadata: %s", sqlite3_errmsg(db));
+        log_error("Failed to update recording file path: %s", sqlite3_errmsg(db));
+        result = -1;
+    } else {
+        result = sqlite3_changes(db) > 0 ? 0 : 1;
+    }
+    sqlite3_finalize(stmt);
+    
+    if (result == 0) {
+        if (sqlite3_prepare_v2(db, "UPDATE compacted_recordings SET container = ? WHERE container = ?;",
+                               -1, &stmt, NULL) != SQLITE_OK) {
+            result = -1;
+        } else {
+            sqlite3_bind_text(stmt, 1, new_path, -1, SQLITE_STATIC);
+            sqlite3_bind_text(stmt, 2, old_path, -1, SQLITE_STATIC);
+            if (sqlite3_step(stmt) != SQLITE_DONE) {
+                result = -1;
+            }
+            sqlite3_finalize(stmt);
+        }
+    }
+    
+    if (result != 0 || sqlite3_exec(db, "COMMIT;", NULL, NULL, &err_msg) != SQLITE_OK) {
+        if (result >= 0 && err_msg) {
+            log_error("Failed to move recording file path: %s", err_msg);
+            result = -1;
+        }
+        sqlite3_free(err_msg);
+        sqlite3_exec(db, "ROLLBACK;", NULL, NULL, NULL);
+    }
+    pthread_mutex_unlock(db_mutex);
+    
+    return result;
+}
+
+// Usage change of one thinned recording, applied once committed
+typedef struct {
+    uint64_t id;
+    char stream_name[64];
+    uint64_t size_bytes;
+    uint64_t new_size;
+    time_t start_time;
+    time_t end_time;
+} thinned_usage_t;
+
+// Mark a recording whose file was rewritten with only its key frames
+int mark_recording_thinned(uint64_t id, const char *file_path, uint64_t file_size) {
+    sqlite3 *db = get_db_handle();
+    pthread_mutex_t *db_mutex = get_db_mutex();
+    
+    if (!db || !file_path) {
+        log_error("Database not initialized");
+        return -1;
+    }
+    
+    lock_db_mutex();
+    
+    char *err_msg = NULL;
+    if (sqlite3_exec(db, "BEGIN TRANSACTION;", NULL, NULL, &err_msg) != SQLITE_OK) {
+        log_error("Failed to begin transaction: %s", err_msg);
+        sqlite3_free(err_msg);
+        pthread_mutex_unlock(db_mutex);
+        return -1;
+    }
+    
+    // The recording, and any compacted into the same file with it
+    thinned_usage_t *rows = NULL;
+    int count = 0;
+    uint64_t old_total = 0;
+    sqlite3_stmt *stmt;
+    int rc = sqlite3_prepare_v2(db, "SELECT id, stream_name, size_bytes, start_time, end_time FROM recordings "
+                                    "WHERE file_path = ?2 AND (id = ?1 OR id IN "
+                                    "(SELECT recording_id FROM compacted_recordings WHERE container = ?2));",
+                                -1, &stmt, NULL);
+    if (rc == SQLITE_OK) {
+        sqlite3_bind_int64(stmt, 1, (sqlite3_int64)id);
+        sqlite3_bind_text(stmt, 2, file_path, -1, SQLITE_STATIC);
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+            thinned_usage_t *grown = realloc(rows, (size_t)(count + 1) * sizeof(thinned_usage_t));
+            if (!grown) {
+                break;
+            }
+            rows = grown;
+            thinned_usage_t *row = &rows[count++];
+            const char *name = (const char *)sqlite3_column_text(stmt, 1);
+            row->id = (uint64_t)sqlite3_column_int64(stmt, 0);
+            snprintf(row->stream_name, sizeof(row->stream_name), "%s", name ? name : "");
+            row->size_bytes = (uint64_t)sqlite3_column_int64(stmt, 2);
+            row->start_time = (time_t)sqlite3_column_int64(stmt, 3);
+            row->end_time = (time_t)sqlite3_column_int64(stmt, 4);
+            old_total += row->size_bytes;
+        }
+        rc = rc == SQLITE_DONE ? SQLITE_OK : SQLITE_ERROR;
+        sqlite3_finalize(stmt);
+    }
+    
+    // Each keeps its share of the file
+    uint64_t assigned = 0;
+    for (int i = 0; i < count; i++) {
+        rows[i].new_size = old_total > 0 ? (uint64_t)((double)file_size * rows[i].size_bytes / old_total)
+                                         : file_size / (uint64_t)count;
+        assigned += rows[i].new_size;
+    }
+    if (count > 0) {
+        rows[count - 1].new_size += file_size - assigned;
+    }
+    
+    if (rc == SQLITE_OK && count > 0) {
+        rc = sqlite3_prepare_v2(db, "UPDATE recordings SET size_bytes = ?, thinned = 1 WHERE id = ?;",
+                                -1, &stmt, NULL);
+        for (int i = 0; i < count && rc == SQLITE_OK; i++) {
+            sqlite3_bind_int64(stmt, 1, (sqlite3_int64)rows[i].new_size);
+            sqlite3_bind_int64(stmt, 2, (sqlite3_int64)rows[i].id);
+            rc = sqlite3_step(stmt) == SQLITE_DONE ? SQLITE_OK : SQLITE_ERROR;
+            sqlite3_reset(stmt);
+        }
         sqlite3_finalize(stmt);
+    }
+    
+    if (rc != SQLITE_OK || count == 0 || sqlite3_exec(db, "COMMIT;", NULL, NULL, &err_msg) != SQLITE_OK) {
+        // Nothing found means the recording was deleted or moved meanwhile
+        int result = rc != SQLITE_OK || err_msg ? -1 : 1;
+        if (result < 0) {
+            log_error("Failed to mark recording %llu thinned: %s", (unsigned long long)id,
+                      err_msg ? err_msg : sqlite3_errmsg(db));
+        }
+        sqlite3_free(err_msg);
+        sqlite3_exec(db, "ROLLBACK;", NULL, NULL, NULL);
+        pthread_mutex_unlock(db_mutex);
+        free(rows);
+        return result;
+    }
+    
+    for (int i = 0; i < count; i++) {
+        recording_usage_resize(rows[i].stream_name, (int64_t)rows[i].new_size - (int64_t)rows[i].size_bytes,
+                               rows[i].start_time, rows[i].end_time);
+    }
+    pthread_mutex_unlock(db_mutex);
+    free(rows);
+    
+    return 0;
+}
+
+// Delete recording metadata and queue the file for the deletion worker
+int delete_recording_deferred(uint64_t id) {
+    sqlite3 *db = get_db_handle();
+    pthread_mutex_t *db_mutex = get_db_mutex();
+    
+    if (!db) {
+        log_error("Database not initialized");
+        return -1;
+    }
+    
+    lock_db_mutex();
+    
+    char stream_name[64];
+    uint64_t size = 0;
+    time_t start_time = 0;
+    time_t end_time = 0;
+    if (lookup_recording_usage(id, stream_name, sizeof(stream_name), &size, &start_time, &end_time) != 0) {
+        log_error("Recording not found: %llu", (unsigned long long)id);
+        pthread_mutex_unlock(db_mutex);
+        return -1;
+    }
+    
+    char *err_msg = NULL;
+    if (sqlite3_exec(db, "BEGIN TRANSACTION;", NULL, NULL, &err_msg) != SQLITE_OK) {
+        log_error("Failed to begin transaction: %s", err_msg);
+        sqlite3_free(err_msg);
         pthread_mutex_unlock(db_mutex);
         return -1;
     }
     
-    deleted_count = sqlite3_changes(db);
+    sqlite3_stmt *stmt;
+    int rc = sqlite3_prepare_v2(db, "INSERT INTO pending_file_deletions (file_path, queued_at) "
+                                    "SELECT file_path, ? FROM recordings WHERE id = ? AND file_path != '' "
+                                    "AND id NOT IN (SELECT recording_id FROM compacted_recordings);",
+                                -1, &stmt, NULL);
+    if (rc == SQLITE_OK) {
+        sqlite3_bind_int64(stmt, 1, (sqlite3_int64)time(NULL));
+        sqlite3_bind_int64(stmt, 2, (sqlite3_int64)id);
+        rc = sqlite3_step(stmt) == SQLITE_DONE ? SQLITE_OK : SQLITE_ERROR;
+        sqlite3_finalize(stmt);
+    }
     
+    if (rc == SQLITE_OK) {
+        stmt = get_cached_stmt(DB_STMT_RECORDING_DELETE, "DELETE FROM recordings WHERE id = ?;");
+        rc = stmt ? SQLITE_OK : SQLITE_ERROR;
+        if (stmt) {
+            sqlite3_bind_int64(stmt, 1, (sqlite3_int64)id);
+            rc = sqlite3_step(stmt) == SQLITE_DONE ? SQLITE_OK : SQLITE_ERROR;
+            release_cached_stmt(stmt);
+        }
+    }
+    
+    if (rc != SQLITE_OK || sqlite3_exec(db, "COMMIT;", NULL, NULL, &err_msg) != SQLITE_OK) {
+        log_error("Failed to delete recording %llu: %s", (unsigned long long)id,
+                  err_msg ? err_msg : sqlite3_errmsg(db));
+        sqlite3_free(err_msg);
+        sqlite3_exec(db, "ROLLBACK;", NULL, NULL, NULL);
+        pthread_mutex_unlock(db_mutex);
+        return -1;
+    }
+    
+    recording_usage_remove(stream_name, 1, size, start_time, end_time);
+    pthread_mutex_unlock(db_mutex);
+    
+    return 0;
+}
+
+// IDs per statement in batch deletes, below SQLite's default limit of 999 parameters
+#define DELETE_BATCH_IDS 500
+
+/**
+ * Prepare a statement ending in an IN list of count parameters, bound to ids
+ * Parameter 1 is left for the caller when first_param is 2.
+ */
+static sqlite3_stmt *prepare_id_list(sqlite3 *db, const char *prefix, const char *suffix,
+                                     const uint64_t *ids, int count, int first_param) {
+    size_t size = strlen(prefix) + strlen(suffix) + (size_t)count * 2 + 4;
+    char *sql = malloc(size);
+    if (!sql) {
+        return NULL;
+    }
+    char *p = sql + sprintf(sql, "%s(", prefix);
+    for (int i = 0; i < count; i++) {
+        *p++ = '?';
+        *p++ = i + 1 < count ? ',' : ')';
+    }
+    strcpy(p, suffix);
+
+    sqlite3_stmt *stmt = NULL;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+        stmt = NULL;
+    }
+    free(sql);
+    for (int i = 0; stmt && i < count; i++) {
+        sqlite3_bind_int64(stmt, first_param + i, (sqlite3_int64)ids[i]);
+    }
+    return stmt;
+}
+
+static int step_and_finalize(sqlite3_stmt *stmt) {
+    if (!stmt) {
+        return SQLITE_ERROR;
+    }
+    int rc = sqlite3_step(stmt) == SQLITE_DONE ? SQLITE_OK : SQLITE_ERROR;
     sqlite3_finalize(stmt);
+    return rc;
+}
+
+// Delete many recordings and queue their files
+int delete_recordings_deferred(const uint64_t *ids, int count, bool *deleted,
+                               recording_delete_progress_fn progress, void *opaque) {
+    sqlite3 *db = get_db_handle();
+    pthread_mutex_t *db_mutex = get_db_mutex();
+
+    if (!db) {
+        log_error("Database not initialized");
+        return -1;
+    }
+    if (deleted) {
+        memset(deleted, 0, (size_t)count * sizeof(bool));
+    }
+    if (!ids || count <= 0) {
+        return 0;
+    }
+
+    // What each stream loses, for the usage totals once the transaction commits
+    typedef struct {
+        char stream_name[64];
+        int count;
+        uint64_t size_bytes;
+        time_t start_time;
+        time_t end_time;
+    } removed_usage_t;
+    removed_usage_t *removed = calloc(MAX_USAGE_STREAMS, sizeof(removed_usage_t));
+    if (!removed) {
+        return -1;
+    }
+    int removed_streams = 0;
+    int deleted_count = 0;
+
+    lock_db_mutex();
+
+    char *err_msg = NULL;
+    if (sqlite3_exec(db, "BEGIN TRANSACTION;", NULL, NULL, &err_msg) != SQLITE_OK) {
+        log_error("Failed to begin transaction: %s", err_msg);
+        sqlite3_free(err_msg);
+        pthread_mutex_unlock(db_mutex);
+        free(removed);
+        return -1;
+    }
+
+    int rc = SQLITE_OK;
+    time_t now = time(NULL);
+    for (int first = 0; first < count && rc == SQLITE_OK; first += DELETE_BATCH_IDS) {
+        int n = count - first < DELETE_BATCH_IDS ? count - first : DELETE_BATCH_IDS;
+        const uint64_t *chunk = &ids[first];
+
+        // Resolve the chunk's recordings in one query
+        sqlite3_stmt *stmt = prepare_id_list(db, "SELECT id, stream_name, size_bytes, start_time, end_time "
+                                                 "FROM recordings WHERE id IN ", ";", chunk, n, 1);
+        if (!stmt) {
+            rc = SQLITE_ERROR;
+            break;
+        }
+        int step;
+        while ((step = sqlite3_step(stmt)) == SQLITE_ROW) {
+            uint64_t id = (uint64_t)sqlite3_column_int64(stmt, 0);
+            const char *name = (const char *)sqlite3_column_text(stmt, 1);
+            for (int i = 0; i < n; i++) {
+                if (chunk[i] == id && deleted) {
+                    deleted[first + i] = true;
+                }
+            }
+            deleted_count++;
+
+            int s = 0;
+            while (s < removed_streams && strcmp(removed[s].stream_name, name ? name : "") != 0) {
+                s++;
+            }
+            if (s == removed_streams) {
+                if (removed_streams == MAX_USAGE_STREAMS) {
+                    continue;
+                }
+                removed_streams++;
+                strncpy(removed[s].stream_name, name ? name : "", sizeof(removed[s].stream_name) - 1);
+                removed[s].start_time = (time_t)sqlite3_column_int64(stmt, 3);
+                removed[s].end_time = 0;
+            }
+            time_t start_time = (time_t)sqlite3_column_int64(stmt, 3);
+            time_t end_time = (time_t)sqlite3_column_int64(stmt, 4);
+            removed[s].count++;
+            removed[s].size_bytes += (uint64_t)sqlite3_column_int64(stmt, 2);
+            if (start_time < removed[s].start_time) {
+                removed[s].start_time = start_time;
+            }
+            if (end_time > removed[s].end_time) {
+                removed[s].end_time = end_time;
+            }
+        }
+        sqlite3_finalize(stmt);
+        if (step != SQLITE_DONE) {
+            rc = SQLITE_ERROR;
+            break;
+        }
+
+        stmt = prepare_id_list(db, "INSERT INTO pending_file_deletions (file_path, queued_at) "
+                                   "SELECT file_path, ? FROM recordings WHERE id IN ",
+                               " AND file_path != '' AND id NOT IN (SELECT recording_id FROM compacted_recordings);",
+                               chunk, n, 2);
+        if (stmt) {
+            sqlite3_bind_int64(stmt, 1, (sqlite3_int64)now);
+        }
+        rc = step_and_finalize(stmt);
+        if (rc == SQLITE_OK) {
+            rc = step_and_finalize(prepare_id_list(db, "DELETE FROM recordings WHERE id IN ", ";",
+                                                   chunk, n, 1));
+        }
+
+        if (rc == SQLITE_OK && progress) {
+            progress(first + n, count, opaque);
+        }
+    }
+
+    if (rc != SQLITE_OK || sqlite3_exec(db, "COMMIT;", NULL, NULL, &err_msg) != SQLITE_OK) {
+        log_error("Failed to delete %d recordings: %s", count,
+                  err_msg ? err_msg : sqlite3_errmsg(db));
+        sqlite3_free(err_msg);
+        sqlite3_exec(db, "ROLLBACK;", NULL, NULL, NULL);
+        pthread_mutex_unlock(db_mutex);
+        if (deleted) {
+            memset(deleted, 0, (size_t)count * sizeof(bool));
+        }
+        free(removed);
+        return -1;
+    }
+
+    for (int s = 0; s < removed_streams; s++) {
+        recording_usage_remove(removed[s].stream_name, removed[s].count, removed[s].size_bytes,
+                               removed[s].start_time, removed[s].end_time);
+    }
     pthread_mutex_unlock(db_mutex);
+    free(removed);
+
+    return deleted_count;
+}
+
+// Get the oldest files waiting to be unlinked
+int get_pending_file_deletions(pending_file_deletion_t *pending, int max_count) {
+    sqlite3 *db = get_db_handle();
+    pthread_mutex_t *db_mutex = get_db_mutex();
+    
+    if (!db) {
+        log_error("Database not initialized");
+        return -1;
+    }
+    
+    lock_db_mutex();
+    
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, "SELECT id, file_path FROM pending_file_deletions ORDER BY id LIMIT ?;",
+                           -1, &stmt, NULL) != SQLITE_OK) {
+        log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+        pthread_mutex_unlock(db_mutex);
+        return -1;
+    }
+    
+    sqlite3_bind_int(stmt, 1, max_count);
+    
+    int count = 0;
+    while (count < max_count && sqlite3_step(stmt) == SQLITE_ROW) {
+        const char *path = (const char *)sqlite3_column_text(stmt, 1);
+        pending[count].id = sqlite3_column_int64(stmt, 0);
+        strncpy(pending[count].file_path, path ? path : "", sizeof(pending[count].file_path) - 1);
+        pending[count].file_path[sizeof(pending[count].file_path) - 1] = '\0';
+        count++;
+    }
+    
+    sqlite3_finalize(stmt);
+    pthread_mutex_unlock(db_mutex);
+    
+    return count;
+}
+
+// Remove files from the deletion queue
+int remove_pending_file_deletions(const int64_t *ids, int count) {
+    sqlite3 *db = get_db_handle();
+    pthread_mutex_t *db_mutex = get_db_mutex();
+    
+    if (!db) {
+        log_error("Database not initialized");
+        return -1;
+    }
+    
+    lock_db_mutex();
+    
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, "DELETE FROM pending_file_deletions WHERE id = ?;", -1, &stmt, NULL) != SQLITE_OK) {
+        log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+        pthread_mutex_unlock(db_mutex);
+        return -1;
+    }
+    
+    sqlite3_exec(db, "BEGIN TRANSACTION;", NULL, NULL, NULL);
+    for (int i = 0; i < count; i++) {
+        sqlite3_bind_int64(stmt, 1, ids[i]);
+        sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+    }
+    int rc = sqlite3_exec(db, "COMMIT;", NULL, NULL, NULL);
+    
+    sqlite3_finalize(stmt);
+    pthread_mutex_unlock(db_mutex);
+    
+    return rc == SQLITE_OK ? 0 : -1;
+}
+
+// Streams with their own retention_days are expired by the retention engine
+#define OWN_RETENTION_EXCLUDED "stream_name NOT IN (SELECT name FROM streams WHERE retention_days > 0)"
+
+// Delete old recording metadata from the database
+int delete_old_recording_metadata(uint64_t max_age) {
+    // Calculate cutoff time
+    time_t cutoff_time = time(NULL) - max_age;
+    
+    // What each stream loses, for the usage totals; recordings that expire
+    // are finished, so none of these change while the batches run
+    typedef struct {
+        char stream_name[64];
+        int count;
+        uint64_t size_bytes;
+    } expired_usage_t;
+    expired_usage_t expired[MAX_USAGE_STREAMS];
+    int expired_streams = 0;
+    
+    sqlite3 *db = get_db_handle();
+    pthread_mutex_t *db_mutex = get_db_mutex();
+    if (db) {
+        lock_db_mutex();
+        sqlite3_stmt *stmt;
+        if (sqlite3_prepare_v2(db, "SELECT stream_name, COUNT(*), SUM(size_bytes) FROM recordings "
+                                   "WHERE end_time < ? AND " OWN_RETENTION_EXCLUDED
+                                   " GROUP BY stream_id;", -1, &stmt, NULL) == SQLITE_OK) {
+            sqlite3_bind_int64(stmt, 1, (sqlite3_int64)cutoff_time);
+            while (expired_streams < (int)(sizeof(expired) / sizeof(expired[0])) &&
+                   sqlite3_step(stmt) == SQLITE_ROW) {
+                const char *name = (const char *)sqlite3_column_text(stmt, 0);
+                expired_usage_t *e = &expired[expired_streams++];
+                strncpy(e->stream_name, name ? name : "", sizeof(e->stream_name) - 1);
+                e->stream_name[sizeof(e->stream_name) - 1] = '\0';
+                e->count = sqlite3_column_int(stmt, 1);
+                e->size_bytes = (uint64_t)sqlite3_column_int64(stmt, 2);
+            }
+            sqlite3_finalize(stmt);
+        }
+        pthread_mutex_unlock(db_mutex);
+    }
+    
+    // Bounded batches, so a large backlog does not lock the database
+    const char *sql = "DELETE FROM recordings WHERE id IN "
+                      "(SELECT id FROM recordings WHERE end_time < ? AND " OWN_RETENTION_EXCLUDED " LIMIT ?);";
+    
+    int deleted_count = delete_rows_in_batches(sql, cutoff_time);
+    if (deleted_count < 0) {
+        log_error("Failed to delete old recording metadata");
+        return deleted_count;
+    }
+    
+    for (int i = 0; i < expired_streams; i++) {
+        recording_usage_remove(expired[i].stream_name, expired[i].count, expired[i].size_bytes,
+                               0, cutoff_time);
+    }
     
     return deleted_count;
 }
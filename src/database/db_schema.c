@@ -5,16 +5,20 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include <sqlite3.h>
 #include <stdbool.h>
 
 #include "database/db_schema.h"
 #include "database/db_core.h"
 #include "database/db_schema_utils.h"
+#include "database/db_streams.h"
+#include "database/db_partitions.h"
+#include "database/db_detection_search.h"
 #include "core/logger.h"
 
 // Current schema version - increment this when adding new migrations
-#define CURRENT_SCHEMA_VERSION 6
+#define CURRENT_SCHEMA_VERSION 25
 
 // Migration function type
 typedef int (*migration_func_t)(void);
@@ -25,6 +29,25 @@ static int migration_v2_to_v3(void);
 static int migration_v3_to_v4(void);
 static int migration_v4_to_v5(void);
 static int migration_v5_to_v6(void);
+static int migration_v6_to_v7(void);
+static int migration_v7_to_v8(void);
+static int migration_v8_to_v9(void);
+static int migration_v9_to_v10(void);
+static int migration_v10_to_v11(void);
+static int migration_v11_to_v12(void);
+static int migration_v12_to_v13(void);
+static int migration_v13_to_v14(void);
+static int migration_v14_to_v15(void);
+static int migration_v15_to_v16(void);
+static int migration_v16_to_v17(void);
+static int migration_v17_to_v18(void);
+static int migration_v18_to_v19(void);
+static int migration_v19_to_v20(void);
+static int migration_v20_to_v21(void);
+static int migration_v21_to_v22(void);
+static int migration_v22_to_v23(void);
+static int migration_v23_to_v24(void);
+static int migration_v24_to_v25(void);
 
 // Array of migration functions
 static migration_func_t migrations[] = {
@@ -33,7 +56,26 @@ static migration_func_t migrations[] = {
     migration_v2_to_v3, // v2->v3
     migration_v3_to_v4, // v3->v4
     migration_v4_to_v5, // v4->v5
-    migration_v5_to_v6  // v5->v6
+    migration_v5_to_v6, // v5->v6
+    migration_v6_to_v7, // v6->v7
+    migration_v7_to_v8, // v7->v8
+    migration_v8_to_v9, // v8->v9
+    migration_v9_to_v10, // v9->v10
+    migration_v10_to_v11, // v10->v11
+    migration_v11_to_v12, // v11->v12
+    migration_v12_to_v13, // v12->v13
+    migration_v13_to_v14, // v13->v14
+    migration_v14_to_v15, // v14->v15
+    migration_v15_to_v16, // v15->v16
+    migration_v16_to_v17, // v16->v17
+    migration_v17_to_v18, // v17->v18
+    migration_v18_to_v19, // v18->v19
+    migration_v19_to_v20, // v19->v20
+    migration_v20_to_v21, // v20->v21
+    migration_v21_to_v22, // v21->v22
+    migration_v22_to_v23, // v22->v23
+    migration_v23_to_v24, // v23->v24
+    migration_v24_to_v25 // v24->v25
 };
 
 /**
@@ -754,3 +796,684 @@ static int migration_v5_to_v6(void) {
     log_info("Completed migration v5 to v6 with result: %d", rc);
     return rc;
 }
+
+/**
+ * Migration from version 6 to 7
+ * - Add detection_frame_step column to streams table
+ */
+static int migration_v6_to_v7(void) {
+    log_info("Running migration from v6 to v7: Adding detection_frame_step column to streams table");
+
+    int rc = 0;
+
+    // 0 keeps the previous behaviour of only decoding key frames for detection
+    log_info("Adding detection_frame_step column");
+    rc |= add_column_if_not_exists("streams", "detection_frame_step", "INTEGER DEFAULT 0");
+
+    log_info("Completed migration v6 to v7 with result: %d", rc);
+    return rc;
+}
+
+/**
+ * Migration from version 7 to 8
+ * - Add detection_url column to streams table
+ */
+static int migration_v7_to_v8(void) {
+    log_info("Running migration from v7 to v8: Adding detection_url column to streams table");
+
+    int rc = 0;
+
+    // Empty means detection runs on the main stream URL
+    log_info("Adding detection_url column");
+    rc |= add_column_if_not_exists("streams", "detection_url", "TEXT DEFAULT ''");
+
+    log_info("Completed migration v7 to v8 with result: %d", rc);
+    return rc;
+}
+
+/**
+ * Migration from version 8 to 9
+ * - Add detection_motion_gate column to streams table
+ */
+static int migration_v8_to_v9(void) {
+    log_info("Running migration from v8 to v9: Adding detection_motion_gate column to streams table");
+
+    int rc = 0;
+
+    // 0 means object detection runs on every sampled frame
+    log_info("Adding detection_motion_gate column");
+    rc |= add_column_if_not_exists("streams", "detection_motion_gate", "INTEGER DEFAULT 0");
+
+    log_info("Completed migration v8 to v9 with result: %d", rc);
+    return rc;
+}
+
+/**
+ * Migration from version 9 to 10
+ * - Add detection_zones column to streams table
+ */
+static int migration_v9_to_v10(void) {
+    log_info("Running migration from v9 to v10: Adding detection_zones column to streams table");
+
+    int rc = 0;
+
+    // Empty means detection covers the whole frame
+    log_info("Adding detection_zones column");
+    rc |= add_column_if_not_exists("streams", "detection_zones", "TEXT DEFAULT ''");
+
+    log_info("Completed migration v9 to v10 with result: %d", rc);
+    return rc;
+}
+
+/**
+ * Migration from version 10 to 11
+ * - Add track_id column to detections table
+ */
+static int migration_v10_to_v11(void) {
+    log_info("Running migration from v10 to v11: Adding track_id column to detections table");
+
+    int rc = 0;
+
+    // 0 marks detections stored before tracking existed
+    log_info("Adding track_id column");
+    rc |= add_column_if_not_exists("detections", "track_id", "INTEGER DEFAULT 0");
+
+    log_info("Completed migration v10 to v11 with result: %d", rc);
+    return rc;
+}
+
+/**
+ * Migration from v11 to v12
+ * Add the tables of the compact detection storage (see db_detection_blocks.h)
+ */
+static int migration_v11_to_v12(void) {
+    log_info("Running migration from v11 to v12: Adding compact detection storage tables");
+
+    int rc;
+    char *err_msg = NULL;
+
+    sqlite3 *db = get_db_handle();
+
+    if (!db) {
+        log_error("Database not initialized");
+        return -1;
+    }
+
+    const char *create_tables =
+        "CREATE TABLE IF NOT EXISTS detection_labels ("
+        "id INTEGER PRIMARY KEY AUTOINCREMENT,"
+        "label TEXT NOT NULL UNIQUE"
+        ");"
+        "CREATE TABLE IF NOT EXISTS detection_blocks ("
+        "stream_name TEXT NOT NULL,"
+        "minute INTEGER NOT NULL,"          // Unix timestamp of the start of the minute
+        "count INTEGER NOT NULL,"           // Detections in data
+        "max_track_id INTEGER DEFAULT 0,"
+        "data BLOB NOT NULL,"               // 16-byte records
+        "PRIMARY KEY (stream_name, minute)"
+        ");"
+        "CREATE TABLE IF NOT EXISTS detection_summary ("
+        "stream_name TEXT NOT NULL,"
+        "minute INTEGER NOT NULL,"
+        "label_id INTEGER NOT NULL,"
+        "count INTEGER NOT NULL,"
+        "max_confidence REAL NOT NULL,"
+        "PRIMARY KEY (stream_name, minute, label_id)"
+        ");"
+        "CREATE INDEX IF NOT EXISTS idx_detection_blocks_minute ON detection_blocks (minute);"
+        "CREATE INDEX IF NOT EXISTS idx_detection_summary_label ON detection_summary (label_id, minute);"
+        "CREATE INDEX IF NOT EXISTS idx_detection_summary_minute ON detection_summary (minute);";
+
+    rc = sqlite3_exec(db, create_tables, NULL, NULL, &err_msg);
+    if (rc != SQLITE_OK) {
+        log_error("Failed to create compact detection tables: %s", err_msg);
+        sqlite3_free(err_msg);
+        return -1;
+    }
+
+    log_info("Completed migration v11 to v12");
+    return 0;
+}
+
+/**
+ * Migration from v12 to v13
+ * Add the queue of recording files waiting to be unlinked
+ */
+static int migration_v12_to_v13(void) {
+    log_info("Running migration from v12 to v13: Adding pending file deletions table");
+
+    int rc;
+    char *err_msg = NULL;
+
+    sqlite3 *db = get_db_handle();
+
+    if (!db) {
+        log_error("Database not initialized");
+        return -1;
+    }
+
+    // Rows outlive a crash, so files queued before it are still deleted
+    const char *create_table =
+        "CREATE TABLE IF NOT EXISTS pending_file_deletions ("
+        "id INTEGER PRIMARY KEY AUTOINCREMENT,"
+        "file_path TEXT NOT NULL,"
+        "queued_at INTEGER NOT NULL"
+        ");";
+
+    rc = sqlite3_exec(db, create_table, NULL, NULL, &err_msg);
+    if (rc != SQLITE_OK) {
+        log_error("Failed to create pending file deletions table: %s", err_msg);
+        sqlite3_free(err_msg);
+        return -1;
+    }
+
+    log_info("Completed migration v12 to v13");
+    return 0;
+}
+
+/**
+ * Migration from version 13 to 14
+ * - Add per-stream retention columns to streams table
+ */
+static int migration_v13_to_v14(void) {
+    log_info("Running migration from v13 to v14: Adding retention columns to streams table");
+
+    int rc = 0;
+
+    // 0 falls back to the global retention and means no quota
+    log_info("Adding retention_days column");
+    rc |= add_column_if_not_exists("streams", "retention_days", "INTEGER DEFAULT 0");
+
+    log_info("Adding max_storage_bytes column");
+    rc |= add_column_if_not_exists("streams", "max_storage_bytes", "INTEGER DEFAULT 0");
+
+    log_info("Adding retention_class column");
+    rc |= add_column_if_not_exists("streams", "retention_class", "INTEGER DEFAULT 0");
+
+    log_info("Completed migration v13 to v14 with result: %d", rc);
+    return rc;
+}
+
+/**
+ * Migration from v14 to v15
+ * Add the cache of ONVIF device capabilities, see db_onvif_cache.h
+ */
+static int migration_v14_to_v15(void) {
+    log_info("Running migration from v14 to v15: Adding ONVIF capability cache tables");
+
+    int rc;
+    char *err_msg = NULL;
+
+    sqlite3 *db = get_db_handle();
+
+    if (!db) {
+        log_error("Database not initialized");
+        return -1;
+    }
+
+    const char *create_tables =
+        "CREATE TABLE IF NOT EXISTS onvif_device_cache ("
+        "device_url TEXT PRIMARY KEY,"
+        "firmware_version TEXT NOT NULL DEFAULT '',"
+        "media_url TEXT NOT NULL DEFAULT '',"
+        "updated_at INTEGER NOT NULL"
+        ");"
+        "CREATE TABLE IF NOT EXISTS onvif_profile_cache ("
+        "device_url TEXT NOT NULL,"
+        "position INTEGER NOT NULL,"
+        "token TEXT NOT NULL,"
+        "name TEXT,"
+        "encoding TEXT,"
+        "width INTEGER,"
+        "height INTEGER,"
+        "fps INTEGER,"
+        "bitrate INTEGER,"
+        "stream_uri TEXT,"
+        "snapshot_uri TEXT,"
+        "PRIMARY KEY (device_url, position)"
+        ");";
+
+    rc = sqlite3_exec(db, create_tables, NULL, NULL, &err_msg);
+    if (rc != SQLITE_OK) {
+        log_error("Failed to create ONVIF cache tables: %s", err_msg);
+        sqlite3_free(err_msg);
+        return -1;
+    }
+
+    log_info("Completed migration v14 to v15");
+    return 0;
+}
+
+/**
+ * Migration from v15 to v16
+ * - Add hls_segment_format column to streams table
+ */
+static int migration_v15_to_v16(void) {
+    log_info("Running migration from v15 to v16: Adding hls_segment_format column to streams table");
+
+    // 0 keeps MPEG-TS segments
+    int rc = add_column_if_not_exists("streams", "hls_segment_format", "INTEGER DEFAULT 0");
+
+    log_info("Completed migration v15 to v16 with result: %d", rc);
+    return rc;
+}
+
+/**
+ * Migration from v16 to v17
+ * Add the segments of recordings kept as HLS segments (hls_recording)
+ */
+static int migration_v16_to_v17(void) {
+    log_info("Running migration from v16 to v17: Adding recording segments table");
+
+    int rc;
+    char *err_msg = NULL;
+
+    sqlite3 *db = get_db_handle();
+
+    if (!db) {
+        log_error("Database not initialized");
+        return -1;
+    }
+
+    // Segments go with their recording however it is deleted
+    const char *create_table =
+        "CREATE TABLE IF NOT EXISTS recording_segments ("
+        "recording_id INTEGER NOT NULL,"
+        "sequence INTEGER NOT NULL,"
+        "file_name TEXT NOT NULL,"          // In the directory of the recording's playlist
+        "start_ms INTEGER NOT NULL,"        // From the start of the recording
+        "duration_ms INTEGER NOT NULL,"
+        "size_bytes INTEGER NOT NULL,"
+        "PRIMARY KEY (recording_id, sequence)"
+        ") WITHOUT ROWID;"
+        "CREATE TRIGGER IF NOT EXISTS recording_segments_delete AFTER DELETE ON recordings "
+        "BEGIN DELETE FROM recording_segments WHERE recording_id = OLD.id; END;";
+
+    rc = sqlite3_exec(db, create_table, NULL, NULL, &err_msg);
+    if (rc != SQLITE_OK) {
+        log_error("Failed to create recording segments table: %s", err_msg);
+        sqlite3_free(err_msg);
+        return -1;
+    }
+
+    log_info("Completed migration v16 to v17");
+    return 0;
+}
+
+/**
+ * Migration from v17 to v18
+ * Index recordings, detections and events by integer stream IDs instead of
+ * stream names, see db_streams.h
+ */
+static int migration_v17_to_v18(void) {
+    log_info("Running migration from v17 to v18: Indexing recordings, detections and events by stream ID");
+
+    int rc;
+    char *err_msg = NULL;
+
+    sqlite3 *db = get_db_handle();
+
+    if (!db) {
+        log_error("Database not initialized");
+        return -1;
+    }
+
+    const char *tables[] = {"recordings", "detections", "events"};
+    for (int i = 0; i < 3; i++) {
+        if (add_column_if_not_exists(tables[i], "stream_id", "INTEGER") != 0) {
+            return -1;
+        }
+    }
+
+    // Every name in use gets an ID, including those of deleted streams
+    const char *migrate =
+        "CREATE TABLE IF NOT EXISTS stream_ids ("
+        "id INTEGER PRIMARY KEY,"
+        "name TEXT NOT NULL UNIQUE"
+        ");"
+        "INSERT OR IGNORE INTO stream_ids (name) SELECT name FROM streams ORDER BY id;"
+        "INSERT OR IGNORE INTO stream_ids (name) SELECT DISTINCT stream_name FROM recordings;"
+        "INSERT OR IGNORE INTO stream_ids (name) SELECT DISTINCT stream_name FROM detections;"
+        "INSERT OR IGNORE INTO stream_ids (name) "
+        "SELECT DISTINCT stream_name FROM events WHERE stream_name IS NOT NULL;"
+        "UPDATE recordings SET stream_id = " STREAM_ID_OF("recordings.stream_name") ";"
+        "UPDATE detections SET stream_id = " STREAM_ID_OF("detections.stream_name") ";"
+        "UPDATE events SET stream_id = " STREAM_ID_OF("events.stream_name") " WHERE stream_name IS NOT NULL;"
+        "DROP INDEX IF EXISTS idx_recordings_stream;"
+        "DROP INDEX IF EXISTS idx_recordings_complete_stream_start;"
+        "DROP INDEX IF EXISTS idx_detections_stream_timestamp;"
+        "DROP INDEX IF EXISTS idx_events_stream;"
+        "CREATE INDEX IF NOT EXISTS idx_recordings_stream_start ON recordings (stream_id, start_time);"
+        "CREATE INDEX IF NOT EXISTS idx_recordings_complete_stream_start ON recordings (is_complete, stream_id, start_time);"
+        "CREATE INDEX IF NOT EXISTS idx_detections_stream_timestamp ON detections (stream_id, timestamp);"
+        "CREATE INDEX IF NOT EXISTS idx_events_stream ON events (stream_id, timestamp);"
+        STREAM_ID_TRIGGER_SQL("recordings")
+        STREAM_ID_TRIGGER_SQL("detections")
+        STREAM_ID_TRIGGER_SQL("events");
+
+    rc = sqlite3_exec(db, migrate, NULL, NULL, &err_msg);
+    if (rc != SQLITE_OK) {
+        log_error("Failed to index by stream ID: %s", err_msg);
+        sqlite3_free(err_msg);
+        return -1;
+    }
+
+    log_info("Completed migration v17 to v18");
+    return 0;
+}
+
+/**
+ * Migration from v18 to v19
+ * Add the per-minute detection activity, see db_detection_activity.h, and
+ * fill it from the detections stored so far
+ */
+static int migration_v18_to_v19(void) {
+    log_info("Running migration from v18 to v19: Adding detection activity table");
+
+    int rc;
+    char *err_msg = NULL;
+
+    sqlite3 *db = get_db_handle();
+
+    if (!db) {
+        log_error("Database not initialized");
+        return -1;
+    }
+
+    const char *create_table =
+        "CREATE TABLE IF NOT EXISTS detection_activity ("
+        "stream_id INTEGER NOT NULL,"
+        "minute INTEGER NOT NULL,"          // Unix timestamp of the start of the minute
+        "label TEXT NOT NULL,"
+        "count INTEGER NOT NULL,"
+        "max_confidence REAL NOT NULL,"     // Highest motion score for label motion
+        "PRIMARY KEY (stream_id, minute, label)"
+        ") WITHOUT ROWID;"
+        "CREATE INDEX IF NOT EXISTS idx_detection_activity_minute ON detection_activity (minute);"
+        "INSERT OR IGNORE INTO stream_ids (name) SELECT DISTINCT stream_name FROM detection_summary;"
+        "INSERT INTO detection_activity (stream_id, minute, label, count, max_confidence) "
+        "SELECT stream_id, timestamp - timestamp % 60, label, COUNT(*), MAX(confidence) "
+        "FROM detections WHERE stream_id IS NOT NULL GROUP BY 1, 2, 3;"
+        "INSERT INTO detection_activity (stream_id, minute, label, count, max_confidence) "
+        "SELECT " STREAM_ID_OF("s.stream_name") ", s.minute, l.label, s.count, s.max_confidence "
+        "FROM detection_summary s JOIN detection_labels l ON l.id = s.label_id WHERE true "
+        "ON CONFLICT (stream_id, minute, label) DO UPDATE SET "
+        "count = count + excluded.count, "
+        "max_confidence = MAX(max_confidence, excluded.max_confidence);";
+
+    rc = sqlite3_exec(db, create_table, NULL, NULL, &err_msg);
+    if (rc != SQLITE_OK) {
+        log_error("Failed to create detection activity table: %s", err_msg);
+        sqlite3_free(err_msg);
+        return -1;
+    }
+
+    // Day partitions are not in the detections table
+    int days[MAX_QUERY_PARTITIONS];
+    int partitions = list_partitions(db, "detections", 0, INT32_MAX, days, MAX_QUERY_PARTITIONS);
+    for (int i = 0; i < partitions; i++) {
+        char name[MAX_PARTITION_NAME];
+        partition_name("detections", days[i], name, sizeof(name));
+
+        char *sql = sqlite3_mprintf(
+            "INSERT OR IGNORE INTO stream_ids (name) SELECT DISTINCT stream_name FROM \"%w\";"
+            "INSERT INTO detection_activity (stream_id, minute, label, count, max_confidence) "
+            "SELECT " STREAM_ID_OF("stream_name") ", timestamp - timestamp %% 60, label, COUNT(*), MAX(confidence) "
+            "FROM \"%w\" WHERE true GROUP BY stream_name, 2, 3 "
+            "ON CONFLICT (stream_id, minute, label) DO UPDATE SET "
+            "count = count + excluded.count, "
+            "max_confidence = MAX(max_confidence, excluded.max_confidence);", name, name);
+        rc = sql ? sqlite3_exec(db, sql, NULL, NULL, &err_msg) : SQLITE_NOMEM;
+        sqlite3_free(sql);
+        if (rc != SQLITE_OK) {
+            log_error("Failed to fill detection activity from %s: %s", name, err_msg ? err_msg : "out of memory");
+            sqlite3_free(err_msg);
+            return -1;
+        }
+    }
+
+    log_info("Completed migration v18 to v19");
+    return 0;
+}
+
+/**
+ * Migration from v19 to v20
+ * Index detections by label ID and time, and activity by label and minute,
+ * for searches across streams, see db_detection_search.h
+ */
+static int migration_v19_to_v20(void) {
+    log_info("Running migration from v19 to v20: Indexing detections by label");
+
+    int rc;
+    char *err_msg = NULL;
+
+    sqlite3 *db = get_db_handle();
+
+    if (!db) {
+        log_error("Database not initialized");
+        return -1;
+    }
+
+    if (add_column_if_not_exists("detections", "label_id", "INTEGER") != 0) {
+        return -1;
+    }
+
+    const char *migrate =
+        "INSERT OR IGNORE INTO detection_labels (label) SELECT DISTINCT label FROM detections;"
+        "UPDATE detections SET label_id = " LABEL_ID_OF("detections.label") ";"
+        "CREATE INDEX IF NOT EXISTS idx_detections_label_timestamp ON detections (label_id, timestamp);"
+        "CREATE INDEX IF NOT EXISTS idx_detection_activity_label ON detection_activity (label, minute);"
+        LABEL_ID_TRIGGER_SQL("detections");
+
+    rc = sqlite3_exec(db, migrate, NULL, NULL, &err_msg);
+    if (rc != SQLITE_OK) {
+        log_error("Failed to index detections by label: %s", err_msg);
+        sqlite3_free(err_msg);
+        return -1;
+    }
+
+    log_info("Completed migration v19 to v20");
+    return 0;
+}
+
+/**
+ * Migration from v20 to v21
+ * Add the queue of recordings waiting to be uploaded, see db_uploads.h
+ */
+static int migration_v20_to_v21(void) {
+    log_info("Running migration from v20 to v21: Adding upload queue table");
+
+    int rc;
+    char *err_msg = NULL;
+
+    sqlite3 *db = get_db_handle();
+
+    if (!db) {
+        log_error("Database not initialized");
+        return -1;
+    }
+
+    const char *create_table =
+        "CREATE TABLE IF NOT EXISTS upload_queue ("
+        "id INTEGER PRIMARY KEY AUTOINCREMENT,"
+        "recording_id INTEGER NOT NULL UNIQUE,"
+        "queued_at INTEGER NOT NULL,"
+        "attempts INTEGER NOT NULL DEFAULT 0,"
+        "next_attempt INTEGER NOT NULL DEFAULT 0,"
+        "upload_id TEXT,"
+        "parts TEXT,"
+        "last_error TEXT"
+        ");"
+        "CREATE INDEX IF NOT EXISTS idx_upload_queue_next_attempt ON upload_queue (next_attempt);";
+
+    rc = sqlite3_exec(db, create_table, NULL, NULL, &err_msg);
+    if (rc != SQLITE_OK) {
+        log_error("Failed to create upload queue table: %s", err_msg);
+        sqlite3_free(err_msg);
+        return -1;
+    }
+
+    log_info("Completed migration v20 to v21");
+    return 0;
+}
+
+/**
+ * Migration from v21 to v22
+ * Add the recordings compacted into shared files (compaction_worker)
+ */
+static int migration_v21_to_v22(void) {
+    log_info("Running migration from v21 to v22: Adding compacted recordings table");
+
+    int rc;
+    char *err_msg = NULL;
+
+    sqlite3 *db = get_db_handle();
+
+    if (!db) {
+        log_error("Database not initialized");
+        return -1;
+    }
+
+    // A compacted recording's file_path is its container, shared with the
+    // other recordings in it. Deleting a recording queues its old file's
+    // thumbnails for removal, and the container once nothing refers to it.
+    const char *create_table =
+        "CREATE TABLE IF NOT EXISTS compacted_recordings ("
+        "recording_id INTEGER PRIMARY KEY,"
+        "container TEXT NOT NULL,"          // Same as the recording's file_path
+        "offset_ms INTEGER NOT NULL,"       // Where the recording starts in the container
+        "duration_ms INTEGER NOT NULL,"
+        "source_path TEXT NOT NULL"         // File the recording had, named its thumbnails
+        ");"
+        "CREATE INDEX IF NOT EXISTS idx_compacted_recordings_container ON compacted_recordings (container);"
+        "CREATE TRIGGER IF NOT EXISTS compacted_recordings_delete AFTER DELETE ON recordings "
+        "WHEN EXISTS (SELECT 1 FROM compacted_recordings WHERE recording_id = OLD.id) BEGIN "
+        "INSERT INTO pending_file_deletions (file_path, queued_at) "
+        "SELECT source_path, CAST(strftime('%s', 'now') AS INTEGER) FROM compacted_recordings "
+        "WHERE recording_id = OLD.id; "
+        "DELETE FROM compacted_recordings WHERE recording_id = OLD.id; "
+        "INSERT INTO pending_file_deletions (file_path, queued_at) "
+        "SELECT OLD.file_path, CAST(strftime('%s', 'now') AS INTEGER) "
+        "WHERE NOT EXISTS (SELECT 1 FROM compacted_recordings WHERE container = OLD.file_path); "
+        "END;";
+
+    rc = sqlite3_exec(db, create_table, NULL, NULL, &err_msg);
+    if (rc != SQLITE_OK) {
+        log_error("Failed to create compacted recordings table: %s", err_msg);
+        sqlite3_free(err_msg);
+        return -1;
+    }
+
+    log_info("Completed migration v21 to v22");
+    return 0;
+}
+
+/**
+ * Migration from v22 to v23
+ * Mark recordings thinned to their key frames (compaction_worker)
+ */
+static int migration_v22_to_v23(void) {
+    log_info("Running migration from v22 to v23: Adding thinned column to recordings table");
+
+    char *err_msg = NULL;
+
+    sqlite3 *db = get_db_handle();
+
+    if (!db) {
+        log_error("Database not initialized");
+        return -1;
+    }
+
+    if (add_column_if_not_exists("recordings", "thinned", "INTEGER DEFAULT 0") != 0) {
+        return -1;
+    }
+
+    // Only recordings still to be thinned are looked up by age
+    if (sqlite3_exec(db, "CREATE INDEX IF NOT EXISTS idx_recordings_unthinned ON recordings (end_time) "
+                         "WHERE thinned = 0;", NULL, NULL, &err_msg) != SQLITE_OK) {
+        log_error("Failed to create unthinned recordings index: %s", err_msg);
+        sqlite3_free(err_msg);
+        return -1;
+    }
+
+    log_info("Completed migration v22 to v23");
+    return 0;
+}
+
+/**
+ * Migration from v23 to v24
+ * - Add motion_mask column to streams table
+ */
+static int migration_v23_to_v24(void) {
+    log_info("Running migration from v23 to v24: Adding motion_mask column to streams table");
+
+    // Empty masks no cells
+    int rc = add_column_if_not_exists("streams", "motion_mask", "TEXT DEFAULT ''");
+
+    log_info("Completed migration v23 to v24 with result: %d", rc);
+    return rc;
+}
+
+/**
+ * Migration from v24 to v25
+ * - Add recording_days table counting the complete recordings of each
+ *   stream and UTC day, kept up to date by triggers, so listings count
+ *   wide ranges without scanning the recordings
+ */
+static int migration_v24_to_v25(void) {
+    log_info("Running migration from v24 to v25: Adding recording_days table");
+
+    char *err_msg = NULL;
+
+    sqlite3 *db = get_db_handle();
+    if (!db) {
+        log_error("Database not initialized");
+        return -1;
+    }
+
+    // Rows are counted like get_recording_count() does: complete, with an end time
+    const char *sql =
+        "CREATE TABLE IF NOT EXISTS recording_days ("
+        "stream_id INTEGER NOT NULL,"
+        "day INTEGER NOT NULL,"
+        "count INTEGER NOT NULL DEFAULT 0,"
+        "PRIMARY KEY (stream_id, day)"
+        ") WITHOUT ROWID;"
+        "DELETE FROM recording_days;"
+        "INSERT INTO recording_days (stream_id, day, count) "
+        "SELECT stream_id, start_time / 86400, COUNT(*) FROM recordings "
+        "WHERE is_complete = 1 AND end_time IS NOT NULL AND stream_id IS NOT NULL "
+        "GROUP BY stream_id, start_time / 86400;"
+        "CREATE TRIGGER IF NOT EXISTS recording_days_insert AFTER INSERT ON recordings "
+        "WHEN NEW.is_complete = 1 AND NEW.end_time IS NOT NULL AND NEW.stream_id IS NOT NULL BEGIN "
+        "INSERT OR IGNORE INTO recording_days (stream_id, day) VALUES (NEW.stream_id, NEW.start_time / 86400); "
+        "UPDATE recording_days SET count = count + 1 WHERE stream_id = NEW.stream_id AND day = NEW.start_time / 86400; "
+        "END;"
+        "CREATE TRIGGER IF NOT EXISTS recording_days_delete AFTER DELETE ON recordings "
+        "WHEN OLD.is_complete = 1 AND OLD.end_time IS NOT NULL AND OLD.stream_id IS NOT NULL BEGIN "
+        "UPDATE recording_days SET count = count - 1 WHERE stream_id = OLD.stream_id AND day = OLD.start_time / 86400; "
+        "DELETE FROM recording_days WHERE stream_id = OLD.stream_id AND day = OLD.start_time / 86400 AND count <= 0; "
+        "END;"
+        // An update moves the row out of its old day, if it was counted, and into its new one
+        "CREATE TRIGGER IF NOT EXISTS recording_days_update_old "
+        "AFTER UPDATE OF is_complete, end_time, start_time, stream_id ON recordings "
+        "WHEN OLD.is_complete = 1 AND OLD.end_time IS NOT NULL AND OLD.stream_id IS NOT NULL BEGIN "
+        "UPDATE recording_days SET count = count - 1 WHERE stream_id = OLD.stream_id AND day = OLD.start_time / 86400; "
+        "DELETE FROM recording_days WHERE stream_id = OLD.stream_id AND day = OLD.start_time / 86400 AND count <= 0; "
+        "END;"
+        "CREATE TRIGGER IF NOT EXISTS recording_days_update_new "
+        "AFTER UPDATE OF is_complete, end_time, start_time, stream_id ON recordings "
+        "WHEN NEW.is_complete = 1 AND NEW.end_time IS NOT NULL AND NEW.stream_id IS NOT NULL BEGIN "
+        "INSERT OR IGNORE INTO recording_days (stream_id, day) VALUES (NEW.stream_id, NEW.start_time / 86400); "
+        "UPDATE recording_days SET count = count + 1 WHERE stream_id = NEW.stream_id AND day = NEW.start_time / 86400; "
+        "END;";
+
+    if (sqlite3_exec(db, sql, NULL, NULL, &err_msg) != SQLITE_OK) {
+        log_error("Failed to create recording days table: %s", err_msg);
+        sqlite3_free(err_msg);
+        return -1;
+    }
+
+    log_info("Completed migration v24 to v25");
+    return 0;
+}
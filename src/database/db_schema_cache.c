@@ -69,6 +69,13 @@ void init_schema_cache(void) {
         bool protocol_exists = column_exists("streams", "protocol");
         bool onvif_exists = column_exists("streams", "is_onvif");
         bool record_audio_exists = column_exists("streams", "record_audio");
+        bool frame_step_exists = column_exists("streams", "detection_frame_step");
+        bool detection_url_exists = column_exists("streams", "detection_url");
+        bool motion_gate_exists = column_exists("streams", "detection_motion_gate");
+        bool zones_exists = column_exists("streams", "detection_zones");
+        bool retention_exists = column_exists("streams", "retention_class");
+        bool hls_format_exists = column_exists("streams", "hls_segment_format");
+        bool motion_mask_exists = column_exists("streams", "motion_mask");
         // is_deleted column has been removed in migration_v5_to_v6
 
         // Add them to the cache manually
@@ -101,6 +108,62 @@ void init_schema_cache(void) {
             column_cache_size++;
         }
 
+        // Add detection_frame_step column to cache
+        if (column_cache_size < column_cache_capacity) {
+            strncpy(column_cache[column_cache_size].table_name, "streams", sizeof(column_cache[column_cache_size].table_name) - 1);
+            strncpy(column_cache[column_cache_size].column_name, "detection_frame_step", sizeof(column_cache[column_cache_size].column_name) - 1);
+            column_cache[column_cache_size].exists = frame_step_exists;
+            column_cache_size++;
+        }
+
+        // Add detection_url column to cache
+        if (column_cache_size < column_cache_capacity) {
+            strncpy(column_cache[column_cache_size].table_name, "streams", sizeof(column_cache[column_cache_size].table_name) - 1);
+            strncpy(column_cache[column_cache_size].column_name, "detection_url", sizeof(column_cache[column_cache_size].column_name) - 1);
+            column_cache[column_cache_size].exists = detection_url_exists;
+            column_cache_size++;
+        }
+
+        // Add detection_motion_gate column to cache
+        if (column_cache_size < column_cache_capacity) {
+            strncpy(column_cache[column_cache_size].table_name, "streams", sizeof(column_cache[column_cache_size].table_name) - 1);
+            strncpy(column_cache[column_cache_size].column_name, "detection_motion_gate", sizeof(column_cache[column_cache_size].column_name) - 1);
+            column_cache[column_cache_size].exists = motion_gate_exists;
+            column_cache_size++;
+        }
+
+        // Add detection_zones column to cache
+        if (column_cache_size < column_cache_capacity) {
+            strncpy(column_cache[column_cache_size].table_name, "streams", sizeof(column_cache[column_cache_size].table_name) - 1);
+            strncpy(column_cache[column_cache_size].column_name, "detection_zones", sizeof(column_cache[column_cache_size].column_name) - 1);
+            column_cache[column_cache_size].exists = zones_exists;
+            column_cache_size++;
+        }
+
+        // Add retention_class column to cache; the retention columns come as a set
+        if (column_cache_size < column_cache_capacity) {
+            strncpy(column_cache[column_cache_size].table_name, "streams", sizeof(column_cache[column_cache_size].table_name) - 1);
+            strncpy(column_cache[column_cache_size].column_name, "retention_class", sizeof(column_cache[column_cache_size].column_name) - 1);
+            column_cache[column_cache_size].exists = retention_exists;
+            column_cache_size++;
+        }
+
+        // Add hls_segment_format column to cache
+        if (column_cache_size < column_cache_capacity) {
+            strncpy(column_cache[column_cache_size].table_name, "streams", sizeof(column_cache[column_cache_size].table_name) - 1);
+            strncpy(column_cache[column_cache_size].column_name, "hls_segment_format", sizeof(column_cache[column_cache_size].column_name) - 1);
+            column_cache[column_cache_size].exists = hls_format_exists;
+            column_cache_size++;
+        }
+
+        // Add motion_mask column to cache
+        if (column_cache_size < column_cache_capacity) {
+            strncpy(column_cache[column_cache_size].table_name, "streams", sizeof(column_cache[column_cache_size].table_name) - 1);
+            strncpy(column_cache[column_cache_size].column_name, "motion_mask", sizeof(column_cache[column_cache_size].column_name) - 1);
+            column_cache[column_cache_size].exists = motion_mask_exists;
+            column_cache_size++;
+        }
+
         // is_deleted column has been removed in migration_v5_to_v6
 
         schema_initialized = true;
@@ -197,7 +260,7 @@ void free_schema_cache(void) {
     // Try to get the database handle safely
     pthread_mutex_t *db_mutex = get_db_mutex();
     if (db_mutex) {
-        pthread_mutex_lock(db_mutex);
+        lock_db_mutex();
         db = get_db_handle();
 
         if (db) {
@@ -8,6 +8,7 @@
 #include <time.h>
 #include <sqlite3.h>
 #include <stdbool.h>
+#include <stdatomic.h>
 
 #include "database/db_streams.h"
 #include "database/db_core.h"
@@ -16,6 +17,23 @@
 #include "core/logger.h"
 #include "core/config.h"
 
+// Bumped by every change to the streams table, see stream_configs_generation()
+static atomic_uint configs_generation = 1;
+
+/**
+ * Note that the streams table changed
+ */
+void stream_configs_changed(void) {
+    atomic_fetch_add(&configs_generation, 1);
+}
+
+/**
+ * Get the generation of the streams table
+ */
+unsigned int stream_configs_generation(void) {
+    return atomic_load(&configs_generation);
+}
+
 /**
  * Add a stream configuration to the database
  *
@@ -40,7 +58,7 @@ uint64_t add_stream_config(const stream_config_t *stream) {
         return 0;
     }
 
-    pthread_mutex_lock(db_mutex);
+    lock_db_mutex();
 
     // Check if a stream with this name already exists but is disabled
     const char *check_sql = "SELECT id FROM streams WHERE name = ? AND enabled = 0;";
@@ -70,7 +88,10 @@ uint64_t add_stream_config(const stream_config_t *stream) {
                                 "fps = ?, codec = ?, priority = ?, record = ?, segment_duration = ?, "
                                 "detection_based_recording = ?, detection_model = ?, detection_threshold = ?, "
                                 "detection_interval = ?, pre_detection_buffer = ?, post_detection_buffer = ?, "
-                                "protocol = ?, is_onvif = ?, record_audio = ? "
+                                "protocol = ?, is_onvif = ?, record_audio = ?, detection_frame_step = ?, detection_url = ?, "
+                                "detection_motion_gate = ?, detection_zones = ?, "
+                                "retention_days = ?, max_storage_bytes = ?, retention_class = ?, "
+                                "hls_segment_format = ?, motion_mask = ? "
                                 "WHERE id = ?;";
 
         rc = sqlite3_prepare_v2(db, update_sql, -1, &stmt, NULL);
@@ -109,8 +130,31 @@ uint64_t add_stream_config(const stream_config_t *stream) {
         // Bind record_audio parameter
         sqlite3_bind_int(stmt, 19, stream->record_audio ? 1 : 0);
 
+        // Bind detection sampling parameter
+        sqlite3_bind_int(stmt, 20, stream->detection_frame_step);
+
+        // Bind detection sub-stream parameter
+        sqlite3_bind_text(stmt, 21, stream->detection_url, -1, SQLITE_STATIC);
+
+        // Bind motion gating parameter
+        sqlite3_bind_int(stmt, 22, (int)stream->detection_motion_gate);
+
+        // Bind detection zones parameter
+        sqlite3_bind_text(stmt, 23, stream->detection_zones, -1, SQLITE_STATIC);
+
+        // Bind retention parameters
+        sqlite3_bind_int(stmt, 24, stream->retention_days);
+        sqlite3_bind_int64(stmt, 25, (sqlite3_int64)stream->max_storage_bytes);
+        sqlite3_bind_int(stmt, 26, (int)stream->retention_class);
+
+        // Bind HLS segment format parameter
+        sqlite3_bind_int(stmt, 27, (int)stream->hls_segment_format);
+
+        // Bind motion mask parameter
+        sqlite3_bind_text(stmt, 28, stream->motion_mask, -1, SQLITE_STATIC);
+
         // Bind ID parameter
-        sqlite3_bind_int64(stmt, 20, (sqlite3_int64)existing_id);
+        sqlite3_bind_int64(stmt, 29, (sqlite3_int64)existing_id);
 
         // Execute statement
         rc = sqlite3_step(stmt);
@@ -138,6 +182,7 @@ uint64_t add_stream_config(const stream_config_t *stream) {
                 stream->detection_based_recording ? "true" : "false",
                 stream->detection_model);
 
+        stream_configs_changed();
         pthread_mutex_unlock(db_mutex);
         return existing_id;
     }
@@ -151,8 +196,10 @@ uint64_t add_stream_config(const stream_config_t *stream) {
     // No disabled stream found, insert a new one
     const char *sql = "INSERT INTO streams (name, url, enabled, streaming_enabled, width, height, fps, codec, priority, record, segment_duration, "
           "detection_based_recording, detection_model, detection_threshold, detection_interval, "
-          "pre_detection_buffer, post_detection_buffer, protocol, is_onvif, record_audio) "
-          "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?);";
+          "pre_detection_buffer, post_detection_buffer, protocol, is_onvif, record_audio, detection_frame_step, detection_url, "
+          "detection_motion_gate, detection_zones, retention_days, max_storage_bytes, retention_class, "
+          "hls_segment_format, motion_mask) "
+          "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?);";
 
     rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
     if (rc != SQLITE_OK) {
@@ -191,6 +238,29 @@ uint64_t add_stream_config(const stream_config_t *stream) {
     // Bind record_audio parameter
     sqlite3_bind_int(stmt, 20, stream->record_audio ? 1 : 0);
 
+    // Bind detection sampling parameter
+    sqlite3_bind_int(stmt, 21, stream->detection_frame_step);
+
+    // Bind detection sub-stream parameter
+    sqlite3_bind_text(stmt, 22, stream->detection_url, -1, SQLITE_STATIC);
+
+    // Bind motion gating parameter
+    sqlite3_bind_int(stmt, 23, (int)stream->detection_motion_gate);
+
+    // Bind detection zones parameter
+    sqlite3_bind_text(stmt, 24, stream->detection_zones, -1, SQLITE_STATIC);
+
+    // Bind retention parameters
+    sqlite3_bind_int(stmt, 25, stream->retention_days);
+    sqlite3_bind_int64(stmt, 26, (sqlite3_int64)stream->max_storage_bytes);
+    sqlite3_bind_int(stmt, 27, (int)stream->retention_class);
+
+    // Bind HLS segment format parameter
+    sqlite3_bind_int(stmt, 28, (int)stream->hls_segment_format);
+
+    // Bind motion mask parameter
+    sqlite3_bind_text(stmt, 29, stream->motion_mask, -1, SQLITE_STATIC);
+
     // Execute statement
     rc = sqlite3_step(stmt);
     if (rc != SQLITE_DONE) {
@@ -213,6 +283,9 @@ uint64_t add_stream_config(const stream_config_t *stream) {
         sqlite3_finalize(stmt);
         stmt = NULL;
     }
+    if (stream_id != 0) {
+        stream_configs_changed();
+    }
     pthread_mutex_unlock(db_mutex);
 
     return stream_id;
@@ -242,7 +315,7 @@ int update_stream_config(const char *name, const stream_config_t *stream) {
         return -1;
     }
 
-    pthread_mutex_lock(db_mutex);
+    lock_db_mutex();
 
     // Schema migrations should have already been run during database initialization
     // No need to check for columns here anymore
@@ -253,7 +326,10 @@ int update_stream_config(const char *name, const stream_config_t *stream) {
                       "fps = ?, codec = ?, priority = ?, record = ?, segment_duration = ?, "
                       "detection_based_recording = ?, detection_model = ?, detection_threshold = ?, "
                       "detection_interval = ?, pre_detection_buffer = ?, post_detection_buffer = ?, "
-                      "protocol = ?, is_onvif = ?, record_audio = ? "
+                      "protocol = ?, is_onvif = ?, record_audio = ?, detection_frame_step = ?, detection_url = ?, "
+                      "detection_motion_gate = ?, detection_zones = ?, "
+                      "retention_days = ?, max_storage_bytes = ?, retention_class = ?, "
+                      "hls_segment_format = ?, motion_mask = ? "
                       "WHERE name = ?;";
 
     rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
@@ -293,8 +369,31 @@ int update_stream_config(const char *name, const stream_config_t *stream) {
     // Bind record_audio parameter
     sqlite3_bind_int(stmt, 20, stream->record_audio ? 1 : 0);
 
+    // Bind detection sampling parameter
+    sqlite3_bind_int(stmt, 21, stream->detection_frame_step);
+
+    // Bind detection sub-stream parameter
+    sqlite3_bind_text(stmt, 22, stream->detection_url, -1, SQLITE_STATIC);
+
+    // Bind motion gating parameter
+    sqlite3_bind_int(stmt, 23, (int)stream->detection_motion_gate);
+
+    // Bind detection zones parameter
+    sqlite3_bind_text(stmt, 24, stream->detection_zones, -1, SQLITE_STATIC);
+
+    // Bind retention parameters
+    sqlite3_bind_int(stmt, 25, stream->retention_days);
+    sqlite3_bind_int64(stmt, 26, (sqlite3_int64)stream->max_storage_bytes);
+    sqlite3_bind_int(stmt, 27, (int)stream->retention_class);
+
+    // Bind HLS segment format parameter
+    sqlite3_bind_int(stmt, 28, (int)stream->hls_segment_format);
+
+    // Bind motion mask parameter
+    sqlite3_bind_text(stmt, 29, stream->motion_mask, -1, SQLITE_STATIC);
+
     // Bind the WHERE clause parameter
-    sqlite3_bind_text(stmt, 21, name, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 30, name, -1, SQLITE_STATIC);
 
     // Execute statement
     rc = sqlite3_step(stmt);
@@ -323,6 +422,7 @@ int update_stream_config(const char *name, const stream_config_t *stream) {
              stream->detection_based_recording ? "true" : "false",
              stream->detection_model);
 
+    stream_configs_changed();
     pthread_mutex_unlock(db_mutex);
 
     return 0;
@@ -362,7 +462,7 @@ int delete_stream_config_internal(const char *name, bool permanent) {
         return -1;
     }
 
-    pthread_mutex_lock(db_mutex);
+    lock_db_mutex();
 
     const char *sql;
     if (permanent) {
@@ -413,6 +513,7 @@ int delete_stream_config_internal(const char *name, bool permanent) {
         log_info("Disabled stream configuration: %s", name);
     }
 
+    stream_configs_changed();
     pthread_mutex_unlock(db_mutex);
 
     return 0;
@@ -426,7 +527,6 @@ int delete_stream_config_internal(const char *name, bool permanent) {
  * @return 0 on success, non-zero on failure
  */
 int get_stream_config_by_name(const char *name, stream_config_t *stream) {
-    int rc;
     sqlite3_stmt *stmt;
     int result = -1;
 
@@ -443,17 +543,78 @@ int get_stream_config_by_name(const char *name, stream_config_t *stream) {
         return -1;
     }
 
-    pthread_mutex_lock(db_mutex);
+    lock_db_mutex();
 
     // Use our cached schema management functions to check for columns
     bool has_detection_columns = cached_column_exists("streams", "detection_based_recording");
     bool has_protocol_column = cached_column_exists("streams", "protocol");
     bool has_onvif_column = cached_column_exists("streams", "is_onvif");
     bool has_record_audio_column = cached_column_exists("streams", "record_audio");
+    bool has_frame_step_column = cached_column_exists("streams", "detection_frame_step");
+    bool has_detection_url_column = cached_column_exists("streams", "detection_url");
+    bool has_motion_gate_column = cached_column_exists("streams", "detection_motion_gate");
+    bool has_zones_column = cached_column_exists("streams", "detection_zones");
+    bool has_retention_columns = cached_column_exists("streams", "retention_class");
+    bool has_hls_format_column = cached_column_exists("streams", "hls_segment_format");
+    bool has_motion_mask_column = cached_column_exists("streams", "motion_mask");
 
     // Prepare SQL based on whether detection columns, protocol column, is_onvif column, and record_audio column exist
     const char *sql;
-    if (has_detection_columns && has_protocol_column && has_onvif_column && has_record_audio_column) {
+    if (has_detection_columns && has_protocol_column && has_onvif_column && has_record_audio_column &&
+        has_frame_step_column && has_detection_url_column && has_motion_gate_column && has_zones_column &&
+        has_retention_columns && has_hls_format_column && has_motion_mask_column) {
+        sql = "SELECT name, url, enabled, streaming_enabled, width, height, fps, codec, priority, record, segment_duration, "
+              "detection_based_recording, detection_model, detection_threshold, detection_interval, "
+              "pre_detection_buffer, post_detection_buffer, protocol, is_onvif, record_audio, detection_frame_step, "
+              "detection_url, detection_motion_gate, detection_zones, retention_days, max_storage_bytes, "
+              "retention_class, hls_segment_format, motion_mask "
+              "FROM streams WHERE name = ?;";
+    } else if (has_detection_columns && has_protocol_column && has_onvif_column && has_record_audio_column &&
+               has_frame_step_column && has_detection_url_column && has_motion_gate_column && has_zones_column &&
+               has_retention_columns && has_hls_format_column) {
+        sql = "SELECT name, url, enabled, streaming_enabled, width, height, fps, codec, priority, record, segment_duration, "
+              "detection_based_recording, detection_model, detection_threshold, detection_interval, "
+              "pre_detection_buffer, post_detection_buffer, protocol, is_onvif, record_audio, detection_frame_step, "
+              "detection_url, detection_motion_gate, detection_zones, retention_days, max_storage_bytes, "
+              "retention_class, hls_segment_format "
+              "FROM streams WHERE name = ?;";
+    } else if (has_detection_columns && has_protocol_column && has_onvif_column && has_record_audio_column &&
+               has_frame_step_column && has_detection_url_column && has_motion_gate_column && has_zones_column &&
+               has_retention_columns) {
+        sql = "SELECT name, url, enabled, streaming_enabled, width, height, fps, codec, priority, record, segment_duration, "
+              "detection_based_recording, detection_model, detection_threshold, detection_interval, "
+              "pre_detection_buffer, post_detection_buffer, protocol, is_onvif, record_audio, detection_frame_step, "
+              "detection_url, detection_motion_gate, detection_zones, retention_days, max_storage_bytes, "
+              "retention_class "
+              "FROM streams WHERE name = ?;";
+    } else if (has_detection_columns && has_protocol_column && has_onvif_column && has_record_audio_column &&
+               has_frame_step_column && has_detection_url_column && has_motion_gate_column && has_zones_column) {
+        sql = "SELECT name, url, enabled, streaming_enabled, width, height, fps, codec, priority, record, segment_duration, "
+              "detection_based_recording, detection_model, detection_threshold, detection_interval, "
+              "pre_detection_buffer, post_detection_buffer, protocol, is_onvif, record_audio, detection_frame_step, "
+              "detection_url, detection_motion_gate, detection_zones "
+              "FROM streams WHERE name = ?;";
+    } else if (has_detection_columns && has_protocol_column && has_onvif_column && has_record_audio_column &&
+               has_frame_step_column && has_detection_url_column && has_motion_gate_column) {
+        sql = "SELECT name, url, enabled, streaming_enabled, width, height, fps, codec, priority, record, segment_duration, "
+              "detection_based_recording, detection_model, detection_threshold, detection_interval, "
+              "pre_detection_buffer, post_detection_buffer, protocol, is_onvif, record_audio, detection_frame_step, "
+              "detection_url, detection_motion_gate "
+              "FROM streams WHERE name = ?;";
+    } else if (has_detection_columns && has_protocol_column && has_onvif_column && has_record_audio_column &&
+               has_frame_step_column && has_detection_url_column) {
+        sql = "SELECT name, url, enabled, streaming_enabled, width, height, fps, codec, priority, record, segment_duration, "
+              "detection_based_recording, detection_model, detection_threshold, detection_interval, "
+              "pre_detection_buffer, post_detection_buffer, protocol, is_onvif, record_audio, detection_frame_step, "
+              "detection_url "
+              "FROM streams WHERE name = ?;";
+    } else if (has_detection_columns && has_protocol_column && has_onvif_column && has_record_audio_column &&
+               has_frame_step_column) {
+        sql = "SELECT name, url, enabled, streaming_enabled, width, height, fps, codec, priority, record, segment_duration, "
+              "detection_based_recording, detection_model, detection_threshold, detection_interval, "
+              "pre_detection_buffer, post_detection_buffer, protocol, is_onvif, record_audio, detection_frame_step "
+              "FROM streams WHERE name = ?;";
+    } else if (has_detection_columns && has_protocol_column && has_onvif_column && has_record_audio_column) {
         sql = "SELECT name, url, enabled, streaming_enabled, width, height, fps, codec, priority, record, segment_duration, "
               "detection_based_recording, detection_model, detection_threshold, detection_interval, "
               "pre_detection_buffer, post_detection_buffer, protocol, is_onvif, record_audio "
@@ -473,9 +634,8 @@ int get_stream_config_by_name(const char *name, stream_config_t *stream) {
               "FROM streams WHERE name = ?;";
     }
 
-    rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
-        log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+    stmt = get_cached_stmt(DB_STMT_STREAM_BY_NAME, sql);
+    if (!stmt) {
         pthread_mutex_unlock(db_mutex);
         return -1;
     }
@@ -569,14 +729,68 @@ int get_stream_config_by_name(const char *name, stream_config_t *stream) {
                     stream->record_audio = sqlite3_column_int(stmt, 19) != 0;
                 }
             }
+
+            // Parse detection_frame_step if it exists (column 20)
+            if (has_frame_step_column && sqlite3_column_count(stmt) > 20) {
+                if (sqlite3_column_type(stmt, 20) != SQLITE_NULL) {
+                    stream->detection_frame_step = sqlite3_column_int(stmt, 20);
+                }
+            }
+
+            // Parse detection_url if it exists (column 21)
+            if (has_detection_url_column && sqlite3_column_count(stmt) > 21) {
+                const char *detection_url = (const char *)sqlite3_column_text(stmt, 21);
+                if (detection_url) {
+                    strncpy(stream->detection_url, detection_url, MAX_URL_LENGTH - 1);
+                    stream->detection_url[MAX_URL_LENGTH - 1] = '\0';
+                }
+            }
+
+            // Parse detection_motion_gate if it exists (column 22)
+            if (has_motion_gate_column && sqlite3_column_count(stmt) > 22) {
+                if (sqlite3_column_type(stmt, 22) != SQLITE_NULL) {
+                    stream->detection_motion_gate = (motion_gate_t)sqlite3_column_int(stmt, 22);
+                }
+            }
+
+            // Parse detection_zones if it exists (column 23)
+            if (has_zones_column && sqlite3_column_count(stmt) > 23) {
+                const char *detection_zones = (const char *)sqlite3_column_text(stmt, 23);
+                if (detection_zones) {
+                    strncpy(stream->detection_zones, detection_zones, MAX_DETECTION_ZONES_TEXT - 1);
+                    stream->detection_zones[MAX_DETECTION_ZONES_TEXT - 1] = '\0';
+                }
+            }
+
+            // Parse retention settings if they exist (columns 24-26)
+            if (has_retention_columns && sqlite3_column_count(stmt) > 26) {
+                stream->retention_days = sqlite3_column_int(stmt, 24);
+                stream->max_storage_bytes = (uint64_t)sqlite3_column_int64(stmt, 25);
+                stream->retention_class = (retention_class_t)sqlite3_column_int(stmt, 26);
+            }
+
+            // Parse hls_segment_format if it exists (column 27)
+            if (has_hls_format_column && sqlite3_column_count(stmt) > 27) {
+                stream->hls_segment_format = sqlite3_column_int(stmt, 27) == HLS_SEGMENT_FMP4 ?
+                                             HLS_SEGMENT_FMP4 : HLS_SEGMENT_MPEGTS;
+            }
+
+            // Parse motion_mask if it exists (column 28)
+            if (has_motion_mask_column && sqlite3_column_count(stmt) > 28) {
+                const char *motion_mask = (const char *)sqlite3_column_text(stmt, 28);
+                if (motion_mask) {
+                    strncpy(stream->motion_mask, motion_mask, MAX_MOTION_MASK_TEXT - 1);
+                    stream->motion_mask[MAX_MOTION_MASK_TEXT - 1] = '\0';
+                }
+            }
         }
 
         result = 0; // Success
     }
 
-    // Finalize the prepared statement
+    // Hand back the cached statement
     if (stmt) {
-        sqlite3_finalize(stmt);
+        release_cached_stmt(stmt);
         stmt = NULL;
     }
     pthread_mutex_unlock(db_mutex);
@@ -609,17 +823,78 @@ int get_all_stream_configs(stream_config_t *streams, int max_count) {
         return -1;
     }
 
-    pthread_mutex_lock(db_mutex);
+    lock_db_mutex();
 
     // Use our cached schema management functions to check for columns
     bool has_detection_columns = cached_column_exists("streams", "detection_based_recording");
     bool has_protocol_column = cached_column_exists("streams", "protocol");
     bool has_onvif_column = cached_column_exists("streams", "is_onvif");
     bool has_record_audio_column = cached_column_exists("streams", "record_audio");
+    bool has_frame_step_column = cached_column_exists("streams", "detection_frame_step");
+    bool has_detection_url_column = cached_column_exists("streams", "detection_url");
+    bool has_motion_gate_column = cached_column_exists("streams", "detection_motion_gate");
+    bool has_zones_column = cached_column_exists("streams", "detection_zones");
+    bool has_retention_columns = cached_column_exists("streams", "retention_class");
+    bool has_hls_format_column = cached_column_exists("streams", "hls_segment_format");
+    bool has_motion_mask_column = cached_column_exists("streams", "motion_mask");
 
     // Prepare SQL based on whether detection columns, protocol column, is_onvif column, and record_audio column exist
     const char *sql;
-    if (has_detection_columns && has_protocol_column && has_onvif_column && has_record_audio_column) {
+    if (has_detection_columns && has_protocol_column && has_onvif_column && has_record_audio_column &&
+        has_frame_step_column && has_detection_url_column && has_motion_gate_column && has_zones_column &&
+        has_retention_columns && has_hls_format_column && has_motion_mask_column) {
+        sql = "SELECT name, url, enabled, streaming_enabled, width, height, fps, codec, priority, record, segment_duration, "
+              "detection_based_recording, detection_model, detection_threshold, detection_interval, "
+              "pre_detection_buffer, post_detection_buffer, protocol, is_onvif, record_audio, detection_frame_step, "
+              "detection_url, detection_motion_gate, detection_zones, retention_days, max_storage_bytes, "
+              "retention_class, hls_segment_format, motion_mask "
+              "FROM streams ORDER BY name;";
+    } else if (has_detection_columns && has_protocol_column && has_onvif_column && has_record_audio_column &&
+               has_frame_step_column && has_detection_url_column && has_motion_gate_column && has_zones_column &&
+               has_retention_columns && has_hls_format_column) {
+        sql = "SELECT name, url, enabled, streaming_enabled, width, height, fps, codec, priority, record, segment_duration, "
+              "detection_based_recording, detection_model, detection_threshold, detection_interval, "
+              "pre_detection_buffer, post_detection_buffer, protocol, is_onvif, record_audio, detection_frame_step, "
+              "detection_url, detection_motion_gate, detection_zones, retention_days, max_storage_bytes, "
+              "retention_class, hls_segment_format "
+              "FROM streams ORDER BY name;";
+    } else if (has_detection_columns && has_protocol_column && has_onvif_column && has_record_audio_column &&
+               has_frame_step_column && has_detection_url_column && has_motion_gate_column && has_zones_column &&
+               has_retention_columns) {
+        sql = "SELECT name, url, enabled, streaming_enabled, width, height, fps, codec, priority, record, segment_duration, "
+              "detection_based_recording, detection_model, detection_threshold, detection_interval, "
+              "pre_detection_buffer, post_detection_buffer, protocol, is_onvif, record_audio, detection_frame_step, "
+              "detection_url, detection_motion_gate, detection_zones, retention_days, max_storage_bytes, "
+              "retention_class "
+              "FROM streams ORDER BY name;";
+    } else if (has_detection_columns && has_protocol_column && has_onvif_column && has_record_audio_column &&
+               has_frame_step_column && has_detection_url_column && has_motion_gate_column && has_zones_column) {
+        sql = "SELECT name, url, enabled, streaming_enabled, width, height, fps, codec, priority, record, segment_duration, "
+              "detection_based_recording, detection_model, detection_threshold, detection_interval, "
+              "pre_detection_buffer, post_detection_buffer, protocol, is_onvif, record_audio, detection_frame_step, "
+              "detection_url, detection_motion_gate, detection_zones "
+              "FROM streams ORDER BY name;";
+    } else if (has_detection_columns && has_protocol_column && has_onvif_column && has_record_audio_column &&
+               has_frame_step_column && has_detection_url_column && has_motion_gate_column) {
+        sql = "SELECT name, url, enabled, streaming_enabled, width, height, fps, codec, priority, record, segment_duration, "
+              "detection_based_recording, detection_model, detection_threshold, detection_interval, "
+              "pre_detection_buffer, post_detection_buffer, protocol, is_onvif, record_audio, detection_frame_step, "
+              "detection_url, detection_motion_gate "
+              "FROM streams ORDER BY name;";
+    } else if (has_detection_columns && has_protocol_column && has_onvif_column && has_record_audio_column &&
+               has_frame_step_column && has_detection_url_column) {
+        sql = "SELECT name, url, enabled, streaming_enabled, width, height, fps, codec, priority, record, segment_duration, "
+              "detection_based_recording, detection_model, detection_threshold, detection_interval, "
+              "pre_detection_buffer, post_detection_buffer, protocol, is_onvif, record_audio, detection_frame_step, "
+              "detection_url "
+              "FROM streams ORDER BY name;";
+    } else if (has_detection_columns && has_protocol_column && has_onvif_column && has_record_audio_column &&
+               has_frame_step_column) {
+        sql = "SELECT name, url, enabled, streaming_enabled, width, height, fps, codec, priority, record, segment_duration, "
+              "detection_based_recording, detection_model, detection_threshold, detection_interval, "
+              "pre_detection_buffer, post_detection_buffer, protocol, is_onvif, record_audio, detection_frame_step "
+              "FROM streams ORDER BY name;";
+    } else if (has_detection_columns && has_protocol_column && has_onvif_column && has_record_audio_column) {
         sql = "SELECT name, url, enabled, streaming_enabled, width, height, fps, codec, priority, record, segment_duration, "
               "detection_based_recording, detection_model, detection_threshold, detection_interval, "
               "pre_detection_buffer, post_detection_buffer, protocol, is_onvif, record_audio "
@@ -732,6 +1007,60 @@ int get_all_stream_configs(stream_config_t *streams, int max_count) {
                     streams[count].record_audio = sqlite3_column_int(stmt, 19) != 0;
                 }
             }
+
+            // Parse detection_frame_step if it exists (column 20)
+            if (has_frame_step_column && sqlite3_column_count(stmt) > 20) {
+                if (sqlite3_column_type(stmt, 20) != SQLITE_NULL) {
+                    streams[count].detection_frame_step = sqlite3_column_int(stmt, 20);
+                }
+            }
+
+            // Parse detection_url if it exists (column 21)
+            if (has_detection_url_column && sqlite3_column_count(stmt) > 21) {
+                const char *detection_url = (const char *)sqlite3_column_text(stmt, 21);
+                if (detection_url) {
+                    strncpy(streams[count].detection_url, detection_url, MAX_URL_LENGTH - 1);
+                    streams[count].detection_url[MAX_URL_LENGTH - 1] = '\0';
+                }
+            }
+
+            // Parse detection_motion_gate if it exists (column 22)
+            if (has_motion_gate_column && sqlite3_column_count(stmt) > 22) {
+                if (sqlite3_column_type(stmt, 22) != SQLITE_NULL) {
+                    streams[count].detection_motion_gate = (motion_gate_t)sqlite3_column_int(stmt, 22);
+                }
+            }
+
+            // Parse detection_zones if it exists (column 23)
+            if (has_zones_column && sqlite3_column_count(stmt) > 23) {
+                const char *detection_zones = (const char *)sqlite3_column_text(stmt, 23);
+                if (detection_zones) {
+                    strncpy(streams[count].detection_zones, detection_zones, MAX_DETECTION_ZONES_TEXT - 1);
+                    streams[count].detection_zones[MAX_DETECTION_ZONES_TEXT - 1] = '\0';
+                }
+            }
+
+            // Parse retention settings if they exist (columns 24-26)
+            if (has_retention_columns && sqlite3_column_count(stmt) > 26) {
+                streams[count].retention_days = sqlite3_column_int(stmt, 24);
+                streams[count].max_storage_bytes = (uint64_t)sqlite3_column_int64(stmt, 25);
+                streams[count].retention_class = (retention_class_t)sqlite3_column_int(stmt, 26);
+            }
+
+            // Parse hls_segment_format if it exists (column 27)
+            if (has_hls_format_column && sqlite3_column_count(stmt) > 27) {
+                streams[count].hls_segment_format = sqlite3_column_int(stmt, 27) == HLS_SEGMENT_FMP4 ?
+                                                    HLS_SEGMENT_FMP4 : HLS_SEGMENT_MPEGTS;
+            }
+
+            // Parse motion_mask if it exists (column 28)
+            if (has_motion_mask_column && sqlite3_column_count(stmt) > 28) {
+                const char *motion_mask = (const char *)sqlite3_column_text(stmt, 28);
+                if (motion_mask) {
+                    strncpy(streams[count].motion_mask, motion_mask, MAX_MOTION_MASK_TEXT - 1);
+                    streams[count].motion_mask[MAX_MOTION_MASK_TEXT - 1] = '\0';
+                }
+            }
         }
 
         count++;
@@ -754,7 +1083,6 @@ int get_all_stream_configs(stream_config_t *streams, int max_count) {
  * @return 1 if eligible, 0 if not eligible, -1 on error
  */
 int is_stream_eligible_for_live_streaming(const char *stream_name) {
-    int rc;
     sqlite3_stmt *stmt;
     int result = -1;
 
@@ -771,13 +1099,12 @@ int is_stream_eligible_for_live_streaming(const char *stream_name) {
         return -1;
     }
 
-    pthread_mutex_lock(db_mutex);
+    lock_db_mutex();
 
     const char *sql = "SELECT enabled, streaming_enabled FROM streams WHERE name = ?;";
 
-    rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
-        log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+    stmt = get_cached_stmt(DB_STMT_STREAM_ELIGIBLE, sql);
+    if (!stmt) {
         pthread_mutex_unlock(db_mutex);
         return -1;
     }
@@ -802,9 +1129,9 @@ int is_stream_eligible_for_live_streaming(const char *stream_name) {
         result = 0; // Not eligible if not found
     }
 
-    // Finalize the prepared statement
+    // Hand back the cached statement
     if (stmt) {
-        sqlite3_finalize(stmt);
+        release_cached_stmt(stmt);
         stmt = NULL;
     }
     pthread_mutex_unlock(db_mutex);
@@ -818,7 +1145,6 @@ int is_stream_eligible_for_live_streaming(const char *stream_name) {
  * @return Number of enabled streams, or -1 on error
  */
 int get_enabled_stream_count(void) {
-    int rc;
     sqlite3_stmt *stmt;
     int count = -1;
 
@@ -830,13 +1156,12 @@ int get_enabled_stream_count(void) {
         return -1;
     }
 
-    pthread_mutex_lock(db_mutex);
+    lock_db_mutex();
 
     const char *sql = "SELECT COUNT(*) FROM streams WHERE enabled = 1;";
 
-    rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
-        log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+    stmt = get_cached_stmt(DB_STMT_STREAM_ENABLED_COUNT, sql);
+    if (!stmt) {
         pthread_mutex_unlock(db_mutex);
         return -1;
     }
@@ -845,8 +1170,8 @@ int get_enabled_stream_count(void) {
         count = sqlite3_column_int(stmt, 0);
     }
 
-    // finalize the prepared statement
-    sqlite3_finalize(stmt);
+    // Hand back the cached statement
+    release_cached_stmt(stmt);
     pthread_mutex_unlock(db_mutex);
 
     return count;
@@ -858,7 +1183,6 @@ int get_enabled_stream_count(void) {
  * @return Number of streams, or -1 on error
  */
 int count_stream_configs(void) {
-    int rc;
     sqlite3_stmt *stmt;
     int count = -1;
 
@@ -870,13 +1194,12 @@ int count_stream_configs(void) {
         return -1;
     }
 
-    pthread_mutex_lock(db_mutex);
+    lock_db_mutex();
 
     const char *sql = "SELECT COUNT(*) FROM streams;";
 
-    rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
-        log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+    stmt = get_cached_stmt(DB_STMT_STREAM_COUNT, sql);
+    if (!stmt) {
         pthread_mutex_unlock(db_mutex);
         return -1;
     }
@@ -885,8 +1208,8 @@ int count_stream_configs(void) {
         count = sqlite3_column_int(stmt, 0);
     }
 
-    // finalize the prepared statement
-    sqlite3_finalize(stmt);
+    // Hand back the cached statement
+    release_cached_stmt(stmt);
     pthread_mutex_unlock(db_mutex);
 
     return count;
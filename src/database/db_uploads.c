@@ -0,0 +1,181 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+#include <sqlite3.h>
+
+#include "database/db_uploads.h"
+#include "database/db_core.h"
+#include "core/logger.h"
+
+static void copy_column(sqlite3_stmt *stmt, int column, char *dest, size_t size) {
+    const char *text = (const char *)sqlite3_column_text(stmt, column);
+    if (text) {
+        strncpy(dest, text, size - 1);
+        dest[size - 1] = '\0';
+    } else {
+        dest[0] = '\0';
+    }
+}
+
+/**
+ * Prepare a statement that changes the queue, holding the database mutex
+ *
+ * @return Statement for finish_write(), or NULL on error
+ */
+static sqlite3_stmt *prepare_write(const char *sql) {
+    sqlite3_stmt *stmt;
+
+    sqlite3 *db = get_db_handle();
+    if (!db) {
+        log_error("Database not initialized");
+        return NULL;
+    }
+
+    lock_db_mutex();
+
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+        pthread_mutex_unlock(get_db_mutex());
+        return NULL;
+    }
+    return stmt;
+}
+
+// Run a statement from prepare_write() and release the database mutex
+static int finish_write(sqlite3_stmt *stmt) {
+    int rc = sqlite3_step(stmt);
+    if (rc != SQLITE_DONE) {
+        log_error("Failed to update upload queue: %s", sqlite3_errmsg(get_db_handle()));
+    }
+    sqlite3_finalize(stmt);
+    pthread_mutex_unlock(get_db_mutex());
+    return rc == SQLITE_DONE ? 0 : -1;
+}
+
+// Queue a recording for upload
+int add_upload(uint64_t recording_id) {
+    sqlite3_stmt *stmt = prepare_write("INSERT OR IGNORE INTO upload_queue "
+                                       "(recording_id, queued_at, next_attempt) VALUES (?, ?, ?);");
+    if (!stmt) {
+        return -1;
+    }
+
+    time_t now = time(NULL);
+    sqlite3_bind_int64(stmt, 1, (sqlite3_int64)recording_id);
+    sqlite3_bind_int64(stmt, 2, (sqlite3_int64)now);
+    sqlite3_bind_int64(stmt, 3, (sqlite3_int64)now);
+    return finish_write(stmt);
+}
+
+// Get the queued upload that is due first
+int get_next_upload(time_t now, upload_entry_t *entry) {
+    sqlite3_stmt *stmt;
+
+    if (!entry) {
+        return -1;
+    }
+
+    sqlite3 *db = acquire_db_reader();
+    if (!db) {
+        log_error("Database not initialized");
+        return -1;
+    }
+
+    if (sqlite3_prepare_v2(db, "SELECT q.id, q.recording_id, q.attempts, q.upload_id, q.parts, "
+                               "r.file_path, r.stream_name FROM upload_queue q "
+                               "LEFT JOIN recordings r ON r.id = q.recording_id "
+                               "WHERE q.next_attempt <= ? ORDER BY q.next_attempt, q.id LIMIT 1;",
+                           -1, &stmt, NULL) != SQLITE_OK) {
+        log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+        release_db_reader(db);
+        return -1;
+    }
+    sqlite3_bind_int64(stmt, 1, (sqlite3_int64)now);
+
+    int result = 0;
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        const char *parts = (const char *)sqlite3_column_text(stmt, 4);
+        memset(entry, 0, sizeof(*entry));
+        entry->id = sqlite3_column_int64(stmt, 0);
+        entry->recording_id = (uint64_t)sqlite3_column_int64(stmt, 1);
+        entry->attempts = sqlite3_column_int(stmt, 2);
+        copy_column(stmt, 3, entry->upload_id, sizeof(entry->upload_id));
+        entry->parts = strdup(parts ? parts : "");
+        copy_column(stmt, 5, entry->file_path, sizeof(entry->file_path));
+        copy_column(stmt, 6, entry->stream_name, sizeof(entry->stream_name));
+        result = entry->parts ? 1 : -1;
+    }
+
+    sqlite3_finalize(stmt);
+    release_db_reader(db);
+    return result;
+}
+
+// Get when the next queued upload is due
+int get_next_upload_time(time_t *when) {
+    sqlite3_stmt *stmt;
+
+    sqlite3 *db = acquire_db_reader();
+    if (!db) {
+        log_error("Database not initialized");
+        return -1;
+    }
+
+    if (sqlite3_prepare_v2(db, "SELECT MIN(next_attempt) FROM upload_queue;", -1, &stmt, NULL) != SQLITE_OK) {
+        log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+        release_db_reader(db);
+        return -1;
+    }
+
+    int result = 0;
+    if (sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_type(stmt, 0) != SQLITE_NULL) {
+        *when = (time_t)sqlite3_column_int64(stmt, 0);
+        result = 1;
+    }
+
+    sqlite3_finalize(stmt);
+    release_db_reader(db);
+    return result;
+}
+
+// Record the progress of a multipart upload
+int set_upload_progress(int64_t id, const char *upload_id, const char *parts) {
+    sqlite3_stmt *stmt = prepare_write("UPDATE upload_queue SET upload_id = ?, parts = ? WHERE id = ?;");
+    if (!stmt) {
+        return -1;
+    }
+
+    sqlite3_bind_text(stmt, 1, upload_id, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, parts, -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 3, id);
+    return finish_write(stmt);
+}
+
+// Record a failed attempt
+int retry_upload(int64_t id, int attempts, time_t next_attempt, const char *error) {
+    sqlite3_stmt *stmt = prepare_write("UPDATE upload_queue SET attempts = ?, next_attempt = ?, last_error = ? "
+                                       "WHERE id = ?;");
+    if (!stmt) {
+        return -1;
+    }
+
+    sqlite3_bind_int(stmt, 1, attempts);
+    sqlite3_bind_int64(stmt, 2, (sqlite3_int64)next_attempt);
+    sqlite3_bind_text(stmt, 3, error, -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 4, id);
+    return finish_write(stmt);
+}
+
+// Remove an upload from the queue
+int remove_upload(int64_t id) {
+    sqlite3_stmt *stmt = prepare_write("DELETE FROM upload_queue WHERE id = ?;");
+    if (!stmt) {
+        return -1;
+    }
+
+    sqlite3_bind_int64(stmt, 1, id);
+    return finish_write(stmt);
+}
@@ -2165,6 +2165,8 @@ struct network {
 	float *output;
 	learning_rate_policy policy;
 	size_t workspace_size;
+	int calibrate_q8; /* Record the input range of each convolutional layer (SOD_CNN_INT8_CALIBRATE) */
+	int opencl; /* Run convolutional and maxpool layers through OpenCL (SOD_CNN_OPENCL) */
 	float learning_rate;
 	float gamma;
 	float scale;
@@ -2242,6 +2244,12 @@ struct layer {
 	int index;
 	int binary;
 	int xnor;
+	int conv_path;
+	signed char *weights_q8; /* Int8 weights, rows padded to SOD_Q8_ALIGN (SOD_CNN_INT8_MODEL) */
+	float *scales_q8;         /* Quantization step of each filter */
+	float input_scale_q8;     /* Quantization step of the input */
+	float input_absmax;       /* Largest input magnitude seen while calibrating */
+	int shared_weights;       /* Weights belong to another network (sod_cnn_create_shared()) */
 	int steps;
 	int hidden;
 	float dot;
@@ -2460,10 +2468,13 @@ struct sod_cnn {
 	int c_rnn;
 	int ow;
 	int oh;
+	int nBatch;    /* Images the layer buffers are allocated for */
+	int nBatchRun; /* Images of the last sod_cnn_predict_batch() */
 	network net; /* The network  */
 	layer det;  /* Detection layer */
 	box *boxes;
 	float **probs;
+	void *aSort;      /* NMS scratch buffers (sod_nms_buf), one entry per box */
 	float *pOut;      /* Prediction output */
 	int nOuput;       /* pOut[] length */
 	const char *zErr; /* Error message if any */
@@ -3647,8 +3658,22 @@ static void make_network(int n, network *out)
 #endif
 	*out = net;
 }
+#ifdef SOD_OPENCL
+/* Forward declaration */
+static void sod_cl_release_weights(const float *weights);
+#endif /* SOD_OPENCL */
 static void free_layer(layer *l, layer *p)
 {
+	if (l->shared_weights) {
+		/* Freed with the network they belong to */
+		l->weights = 0;
+		l->biases = 0;
+		l->scales = 0;
+		l->rolling_mean = 0;
+		l->rolling_variance = 0;
+		l->weights_q8 = 0;
+		l->scales_q8 = 0;
+	}
 	if (l->type == DROPOUT) {
 		if (l->rand)           free(l->rand);
 #if 0 /* SOD_GPU */
@@ -3730,7 +3755,16 @@ static void free_layer(layer *l, layer *p)
 		free(l->scale_updates);
 
 	}
+	if (l->weights_q8) {
+		free(l->weights_q8);
+	}
+	if (l->scales_q8) {
+		free(l->scales_q8);
+	}
 	if (l->weights) {
+#ifdef SOD_OPENCL
+		sod_cl_release_weights(l->weights);
+#endif /* SOD_OPENCL */
 		free(l->weights);
 
 	}
@@ -3936,6 +3970,12 @@ static void forward_network(network *net, network_state state)
 		if (l.delta) {
 			fill_cpu(l.outputs * l.batch, 0, l.delta, 1);
 		}
+		if (net->calibrate_q8 && l.type == CONVOLUTIONAL) {
+			int j;
+			for (j = 0; j < l.inputs * l.batch; ++j) {
+				if (fabsf(state.input[j]) > net->layers[i].input_absmax) net->layers[i].input_absmax = fabsf(state.input[j]);
+			}
+		}
 		l.forward(l, state);
 		state.input = l.output;
 		i++;
@@ -4159,6 +4199,28 @@ static int load_weights(network *net, const char *filename)
 {
 	return load_weights_upto(net, filename, net->n);
 }
+/*
+ * Fold the batch normalization of the convolutional layers into their weights
+ * and biases, so inference runs a single conv + bias + activation pass per layer.
+ * Binary layers keep the separate pass since their weights get binarized.
+ */
+static void fuse_batchnorm_network(network *net)
+{
+	int i, f, j;
+	for (i = 0; i < net->n; ++i) {
+		layer *l = &net->layers[i];
+		int size = l->c*l->size*l->size;
+		if (l->type != CONVOLUTIONAL || !l->batch_normalize || l->binary || l->xnor) continue;
+		for (f = 0; f < l->n; ++f) {
+			float scale = l->scales[f] / (sqrt(l->rolling_variance[f]) + .000001f);
+			for (j = 0; j < size; ++j) {
+				l->weights[f*size + j] *= scale;
+			}
+			l->biases[f] -= l->rolling_mean[f] * scale;
+		}
+		l->batch_normalize = 0;
+	}
+}
 /* =============== CFG Parser ====================== */
 typedef struct node {
 	void *val;
@@ -4601,10 +4663,13 @@ static inline float im2col_get_pixel(float *im, int height, int width,
 /*
 * From Berkeley Vision's Caffe!
 * https://github.com/BVLC/caffe/blob/master/LICENSE
+*
+* Rows of data_col are ldc floats apart, so the matrices of several images
+* can be laid side by side (see forward_convolution_batched()).
 */
-static inline void im2col_cpu(float* data_im,
+static inline void im2col_cpu_ld(float* data_im,
 	int channels, int height, int width,
-	int ksize, int stride, int pad, float* data_col)
+	int ksize, int stride, int pad, float* data_col, int ldc)
 {
 	int c, h, w;
 	int height_col = (height + 2 * pad - ksize) / stride + 1;
@@ -4621,7 +4686,7 @@ static inline void im2col_cpu(float* data_im,
 			for (w = 0; w < width_col; ++w) {
 				im_row = h_offset + h * stride;
 				im_col = w_offset + w * stride;
-				col_index = (c * height_col + h) * width_col + w;
+				col_index = c * ldc + h * width_col + w;
 				data_col[col_index] = im2col_get_pixel(data_im, height, width,
 					im_row, im_col, c_im, pad);
 			}
@@ -4629,6 +4694,14 @@ static inline void im2col_cpu(float* data_im,
 		c++;
 	}
 }
+static inline void im2col_cpu(float* data_im,
+	int channels, int height, int width,
+	int ksize, int stride, int pad, float* data_col)
+{
+	int height_col = (height + 2 * pad - ksize) / stride + 1;
+	int width_col = (width + 2 * pad - ksize) / stride + 1;
+	im2col_cpu_ld(data_im, channels, height, width, ksize, stride, pad, data_col, height_col * width_col);
+}
 #ifdef SOD_EMBEDDED_COMMERCIAL_LICENSE
 /* 
  * Multi-core CPU support for SOD which is available in the commercial version of the library.
@@ -4644,7 +4717,7 @@ static inline void im2col_cpu(float* data_im,
  */
 #include "sod_threads.h"
 #else
-static inline void gemm_nn(int M, int N, int K, float ALPHA,
+static inline void gemm_nn_ref(int M, int N, int K, float ALPHA,
 	float *A, int lda,
 	float *B, int ldb,
 	float *C, int ldc)
@@ -4666,6 +4739,535 @@ static inline void gemm_nn(int M, int N, int K, float ALPHA,
 		i++;
 	}
 }
+#ifdef SOD_BLOCKED_GEMM
+/*
+ * Cache blocked GEMM (C += ALPHA * A * B) for the forward pass.
+ *
+ * B is packed into KC x NC panels that stay in the last level cache and A
+ * into MC x KC panels that stay in L2, both laid out so that the register
+ * blocked microkernel streams through them linearly. The microkernel is
+ * picked once from the CPU: 6x16 AVX2/FMA or 4x8 SSE on x86, 8x8 (AArch64)
+ * or 4x8 (ARMv7) NEON on ARM, and a portable 4x4 kernel otherwise.
+ *
+ * Large products are split over M or N between sod_gemm_threads threads
+ * (SOD_CNN_GEMM_THREADS, 1 by default). Small products, such as the
+ * single column ones of the local layer, keep using the reference loop.
+ */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define SOD_GEMM_X86
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define SOD_GEMM_NEON
+#endif
+#if defined(__unix__) || defined(__APPLE__)
+#include <pthread.h>
+#define SOD_GEMM_PTHREADS
+#endif
+#define SOD_GEMM_KC 256
+#define SOD_GEMM_MC 96
+#define SOD_GEMM_NC 1024
+#define SOD_GEMM_MAX_MR 8
+#define SOD_GEMM_MAX_NR 16
+/* Products below this many multiply-adds are not worth packing */
+#define SOD_GEMM_MIN_WORK (32 * 32 * 32)
+/* Products below this many multiply-adds per thread run on one thread */
+#define SOD_GEMM_MIN_THREAD_WORK (1 << 21)
+#define SOD_GEMM_MAX_THREADS 16
+typedef void(*ProcGemmKernel)(int kc, const float *Ap, const float *Bp, float *C, int ldc);
+typedef struct sod_gemm_kernel sod_gemm_kernel;
+struct sod_gemm_kernel {
+	int mr;
+	int nr;
+	ProcGemmKernel xKernel;
+};
+static int sod_gemm_threads = 1;
+#ifdef SOD_GEMM_PTHREADS
+/* Overrides sod_gemm_threads on the calling thread during sod_cnn_predict_batch() */
+static __thread int sod_gemm_batch_threads = 0;
+#endif /* SOD_GEMM_PTHREADS */
+static void gemm_kernel_4x4(int kc, const float *Ap, const float *Bp, float *C, int ldc)
+{
+	float acc[4][4] = { { 0 } };
+	int k, i, j;
+	for (k = 0; k < kc; ++k) {
+		for (i = 0; i < 4; ++i) {
+			float a = Ap[i];
+			for (j = 0; j < 4; ++j) {
+				acc[i][j] += a * Bp[j];
+			}
+		}
+		Ap += 4;
+		Bp += 4;
+	}
+	for (i = 0; i < 4; ++i) {
+		for (j = 0; j < 4; ++j) {
+			C[i*ldc + j] += acc[i][j];
+		}
+	}
+}
+#ifdef SOD_GEMM_X86
+static void gemm_kernel_sse_4x8(int kc, const float *Ap, const float *Bp, float *C, int ldc)
+{
+	__m128 c00 = _mm_setzero_ps(), c01 = _mm_setzero_ps();
+	__m128 c10 = _mm_setzero_ps(), c11 = _mm_setzero_ps();
+	__m128 c20 = _mm_setzero_ps(), c21 = _mm_setzero_ps();
+	__m128 c30 = _mm_setzero_ps(), c31 = _mm_setzero_ps();
+	int k;
+	for (k = 0; k < kc; ++k) {
+		__m128 b0 = _mm_loadu_ps(Bp);
+		__m128 b1 = _mm_loadu_ps(Bp + 4);
+		__m128 a;
+		a = _mm_set1_ps(Ap[0]); c00 = _mm_add_ps(c00, _mm_mul_ps(a, b0)); c01 = _mm_add_ps(c01, _mm_mul_ps(a, b1));
+		a = _mm_set1_ps(Ap[1]); c10 = _mm_add_ps(c10, _mm_mul_ps(a, b0)); c11 = _mm_add_ps(c11, _mm_mul_ps(a, b1));
+		a = _mm_set1_ps(Ap[2]); c20 = _mm_add_ps(c20, _mm_mul_ps(a, b0)); c21 = _mm_add_ps(c21, _mm_mul_ps(a, b1));
+		a = _mm_set1_ps(Ap[3]); c30 = _mm_add_ps(c30, _mm_mul_ps(a, b0)); c31 = _mm_add_ps(c31, _mm_mul_ps(a, b1));
+		Ap += 4;
+		Bp += 8;
+	}
+#define SOD_GEMM_STORE_SSE(ROW, LO, HI) \
+	_mm_storeu_ps(C + ROW*ldc, _mm_add_ps(_mm_loadu_ps(C + ROW*ldc), LO)); \
+	_mm_storeu_ps(C + ROW*ldc + 4, _mm_add_ps(_mm_loadu_ps(C + ROW*ldc + 4), HI))
+	SOD_GEMM_STORE_SSE(0, c00, c01);
+	SOD_GEMM_STORE_SSE(1, c10, c11);
+	SOD_GEMM_STORE_SSE(2, c20, c21);
+	SOD_GEMM_STORE_SSE(3, c30, c31);
+#undef SOD_GEMM_STORE_SSE
+}
+__attribute__((target("avx2,fma")))
+static void gemm_kernel_avx2_6x16(int kc, const float *Ap, const float *Bp, float *C, int ldc)
+{
+	__m256 c00 = _mm256_setzero_ps(), c01 = _mm256_setzero_ps();
+	__m256 c10 = _mm256_setzero_ps(), c11 = _mm256_setzero_ps();
+	__m256 c20 = _mm256_setzero_ps(), c21 = _mm256_setzero_ps();
+	__m256 c30 = _mm256_setzero_ps(), c31 = _mm256_setzero_ps();
+	__m256 c40 = _mm256_setzero_ps(), c41 = _mm256_setzero_ps();
+	__m256 c50 = _mm256_setzero_ps(), c51 = _mm256_setzero_ps();
+	int k;
+	for (k = 0; k < kc; ++k) {
+		__m256 b0 = _mm256_loadu_ps(Bp);
+		__m256 b1 = _mm256_loadu_ps(Bp + 8);
+		__m256 a;
+		a = _mm256_broadcast_ss(Ap + 0); c00 = _mm256_fmadd_ps(a, b0, c00); c01 = _mm256_fmadd_ps(a, b1, c01);
+		a = _mm256_broadcast_ss(Ap + 1); c10 = _mm256_fmadd_ps(a, b0, c10); c11 = _mm256_fmadd_ps(a, b1, c11);
+		a = _mm256_broadcast_ss(Ap + 2); c20 = _mm256_fmadd_ps(a, b0, c20); c21 = _mm256_fmadd_ps(a, b1, c21);
+		a = _mm256_broadcast_ss(Ap + 3); c30 = _mm256_fmadd_ps(a, b0, c30); c31 = _mm256_fmadd_ps(a, b1, c31);
+		a = _mm256_broadcast_ss(Ap + 4); c40 = _mm256_fmadd_ps(a, b0, c40); c41 = _mm256_fmadd_ps(a, b1, c41);
+		a = _mm256_broadcast_ss(Ap + 5); c50 = _mm256_fmadd_ps(a, b0, c50); c51 = _mm256_fmadd_ps(a, b1, c51);
+		Ap += 6;
+		Bp += 16;
+	}
+#define SOD_GEMM_STORE_AVX(ROW, LO, HI) \
+	_mm256_storeu_ps(C + ROW*ldc, _mm256_add_ps(_mm256_loadu_ps(C + ROW*ldc), LO)); \
+	_mm256_storeu_ps(C + ROW*ldc + 8, _mm256_add_ps(_mm256_loadu_ps(C + ROW*ldc + 8), HI))
+	SOD_GEMM_STORE_AVX(0, c00, c01);
+	SOD_GEMM_STORE_AVX(1, c10, c11);
+	SOD_GEMM_STORE_AVX(2, c20, c21);
+	SOD_GEMM_STORE_AVX(3, c30, c31);
+	SOD_GEMM_STORE_AVX(4, c40, c41);
+	SOD_GEMM_STORE_AVX(5, c50, c51);
+#undef SOD_GEMM_STORE_AVX
+}
+#endif /* SOD_GEMM_X86 */
+#ifdef SOD_GEMM_NEON
+#if defined(__aarch64__)
+#define SOD_NEON_FMA(ACC, B, A) vfmaq_n_f32(ACC, B, A)
+#else
+#define SOD_NEON_FMA(ACC, B, A) vmlaq_n_f32(ACC, B, A)
+#endif
+#define SOD_GEMM_NEON_ROW(ROW) \
+	c##ROW##0 = SOD_NEON_FMA(c##ROW##0, b0, Ap[ROW]); \
+	c##ROW##1 = SOD_NEON_FMA(c##ROW##1, b1, Ap[ROW])
+#define SOD_GEMM_NEON_STORE(ROW) \
+	vst1q_f32(C + ROW*ldc, vaddq_f32(vld1q_f32(C + ROW*ldc), c##ROW##0)); \
+	vst1q_f32(C + ROW*ldc + 4, vaddq_f32(vld1q_f32(C + ROW*ldc + 4), c##ROW##1))
+static void gemm_kernel_neon_4x8(int kc, const float *Ap, const float *Bp, float *C, int ldc)
+{
+	float32x4_t c00 = vdupq_n_f32(0), c01 = vdupq_n_f32(0);
+	float32x4_t c10 = vdupq_n_f32(0), c11 = vdupq_n_f32(0);
+	float32x4_t c20 = vdupq_n_f32(0), c21 = vdupq_n_f32(0);
+	float32x4_t c30 = vdupq_n_f32(0), c31 = vdupq_n_f32(0);
+	int k;
+	for (k = 0; k < kc; ++k) {
+		float32x4_t b0 = vld1q_f32(Bp);
+		float32x4_t b1 = vld1q_f32(Bp + 4);
+		SOD_GEMM_NEON_ROW(0);
+		SOD_GEMM_NEON_ROW(1);
+		SOD_GEMM_NEON_ROW(2);
+		SOD_GEMM_NEON_ROW(3);
+		Ap += 4;
+		Bp += 8;
+	}
+	SOD_GEMM_NEON_STORE(0);
+	SOD_GEMM_NEON_STORE(1);
+	SOD_GEMM_NEON_STORE(2);
+	SOD_GEMM_NEON_STORE(3);
+}
+#if defined(__aarch64__)
+static void gemm_kernel_neon_8x8(int kc, const float *Ap, const float *Bp, float *C, int ldc)
+{
+	float32x4_t c00 = vdupq_n_f32(0), c01 = vdupq_n_f32(0);
+	float32x4_t c10 = vdupq_n_f32(0), c11 = vdupq_n_f32(0);
+	float32x4_t c20 = vdupq_n_f32(0), c21 = vdupq_n_f32(0);
+	float32x4_t c30 = vdupq_n_f32(0), c31 = vdupq_n_f32(0);
+	float32x4_t c40 = vdupq_n_f32(0), c41 = vdupq_n_f32(0);
+	float32x4_t c50 = vdupq_n_f32(0), c51 = vdupq_n_f32(0);
+	float32x4_t c60 = vdupq_n_f32(0), c61 = vdupq_n_f32(0);
+	float32x4_t c70 = vdupq_n_f32(0), c71 = vdupq_n_f32(0);
+	int k;
+	for (k = 0; k < kc; ++k) {
+		float32x4_t b0 = vld1q_f32(Bp);
+		float32x4_t b1 = vld1q_f32(Bp + 4);
+		SOD_GEMM_NEON_ROW(0);
+		SOD_GEMM_NEON_ROW(1);
+		SOD_GEMM_NEON_ROW(2);
+		SOD_GEMM_NEON_ROW(3);
+		SOD_GEMM_NEON_ROW(4);
+		SOD_GEMM_NEON_ROW(5);
+		SOD_GEMM_NEON_ROW(6);
+		SOD_GEMM_NEON_ROW(7);
+		Ap += 8;
+		Bp += 8;
+	}
+	SOD_GEMM_NEON_STORE(0);
+	SOD_GEMM_NEON_STORE(1);
+	SOD_GEMM_NEON_STORE(2);
+	SOD_GEMM_NEON_STORE(3);
+	SOD_GEMM_NEON_STORE(4);
+	SOD_GEMM_NEON_STORE(5);
+	SOD_GEMM_NEON_STORE(6);
+	SOD_GEMM_NEON_STORE(7);
+}
+#endif /* __aarch64__ */
+#undef SOD_GEMM_NEON_ROW
+#undef SOD_GEMM_NEON_STORE
+#undef SOD_NEON_FMA
+#endif /* SOD_GEMM_NEON */
+/* Names of the compiled microkernels, best first */
+static const char *azGemmVariant[] = {
+#if defined(SOD_GEMM_X86)
+	"avx2",
+	"sse",
+#elif defined(SOD_GEMM_NEON)
+	"neon",
+#endif
+	"portable",
+	"reference"
+};
+/* Microkernel in use, found on the first product */
+static sod_gemm_kernel sGemmKernel = { 0, 0, 0 };
+/* Skip the blocked product altogether (the "reference" variant) */
+static int sod_gemm_reference = 0;
+/*
+ * Look up a microkernel by name. Returns 0 when it is not compiled in or
+ * the CPU lacks the instructions it needs.
+ */
+static int gemm_find_kernel(const char *zName, sod_gemm_kernel *pKern)
+{
+#if defined(SOD_GEMM_X86)
+	__builtin_cpu_init();
+	if (strcmp(zName, "avx2") == 0) {
+		if (!__builtin_cpu_supports("avx2") || !__builtin_cpu_supports("fma")) return 0;
+		pKern->mr = 6; pKern->nr = 16;
+		pKern->xKernel = gemm_kernel_avx2_6x16;
+		return 1;
+	}
+	if (strcmp(zName, "sse") == 0) {
+		if (!__builtin_cpu_supports("sse2")) return 0;
+		pKern->mr = 4; pKern->nr = 8;
+		pKern->xKernel = gemm_kernel_sse_4x8;
+		return 1;
+	}
+#elif defined(SOD_GEMM_NEON) && defined(__aarch64__)
+	if (strcmp(zName, "neon") == 0) {
+		pKern->mr = 8; pKern->nr = 8;
+		pKern->xKernel = gemm_kernel_neon_8x8;
+		return 1;
+	}
+#elif defined(SOD_GEMM_NEON)
+	if (strcmp(zName, "neon") == 0) {
+		pKern->mr = 4; pKern->nr = 8;
+		pKern->xKernel = gemm_kernel_neon_4x8;
+		return 1;
+	}
+#endif
+	if (strcmp(zName, "portable") == 0) {
+		pKern->mr = 4; pKern->nr = 4;
+		pKern->xKernel = gemm_kernel_4x4;
+		return 1;
+	}
+	return 0;
+}
+static const sod_gemm_kernel * gemm_select_kernel(void)
+{
+	/* Idempotent, so concurrent first calls only race to the same answer */
+	if (sGemmKernel.xKernel) {
+		return &sGemmKernel;
+	}
+	sod_gemm_kernel sKern = { 0, 0, 0 };
+	size_t i;
+	for (i = 0; i < sizeof(azGemmVariant) / sizeof(azGemmVariant[0]); ++i) {
+		if (gemm_find_kernel(azGemmVariant[i], &sKern)) break;
+	}
+	sGemmKernel.mr = sKern.mr;
+	sGemmKernel.nr = sKern.nr;
+	sGemmKernel.xKernel = sKern.xKernel;
+	return &sGemmKernel;
+}
+static int gemm_list_variants(const char **azVariant, int nMax)
+{
+	sod_gemm_kernel sKern;
+	int n = 0;
+	size_t i;
+	for (i = 0; i < sizeof(azGemmVariant) / sizeof(azGemmVariant[0]) && n < nMax; ++i) {
+		if (strcmp(azGemmVariant[i], "reference") == 0 || gemm_find_kernel(azGemmVariant[i], &sKern)) {
+			azVariant[n++] = azGemmVariant[i];
+		}
+	}
+	return n;
+}
+/* Not thread safe: only for benchmarks, while no network runs */
+static int gemm_use_variant(const char *zVariant)
+{
+	sod_gemm_kernel sKern = { 0, 0, 0 };
+	if (zVariant == 0) {
+		sod_gemm_reference = 0;
+		sGemmKernel.xKernel = 0;
+		gemm_select_kernel();
+		return SOD_OK;
+	}
+	if (strcmp(zVariant, "reference") == 0) {
+		sod_gemm_reference = 1;
+		return SOD_OK;
+	}
+	if (!gemm_find_kernel(zVariant, &sKern)) {
+		return SOD_UNSUPPORTED;
+	}
+	sod_gemm_reference = 0;
+	sGemmKernel = sKern;
+	return SOD_OK;
+}
+/*
+ * Copy a mc x kc block of A into row panels of mr rows, k major, scaled by
+ * ALPHA and zero padded to a multiple of mr rows.
+ */
+static void gemm_pack_a(int mc, int kc, float ALPHA, const float *A, int lda, int mr, float *Ap)
+{
+	int i, k, r;
+	for (i = 0; i < mc; i += mr) {
+		int rows = mc - i < mr ? mc - i : mr;
+		for (k = 0; k < kc; ++k) {
+			for (r = 0; r < rows; ++r) {
+				Ap[r] = ALPHA * A[(i + r)*lda + k];
+			}
+			for (; r < mr; ++r) {
+				Ap[r] = 0;
+			}
+			Ap += mr;
+		}
+	}
+}
+/*
+ * Copy a kc x nc block of B into column panels of nr columns, k major, zero
+ * padded to a multiple of nr columns.
+ */
+static void gemm_pack_b(int kc, int nc, const float *B, int ldb, int nr, float *Bp)
+{
+	int j, k, c;
+	for (j = 0; j < nc; j += nr) {
+		int cols = nc - j < nr ? nc - j : nr;
+		for (k = 0; k < kc; ++k) {
+			const float *row = B + k*ldb + j;
+			for (c = 0; c < cols; ++c) {
+				Bp[c] = row[c];
+			}
+			for (; c < nr; ++c) {
+				Bp[c] = 0;
+			}
+			Bp += nr;
+		}
+	}
+}
+/*
+ * Multiply the packed panels into a mc x nc block of C. Partial tiles at
+ * the right and bottom edges go through a scratch tile.
+ */
+static void gemm_macro_kernel(const sod_gemm_kernel *pKern, int mc, int nc, int kc,
+	const float *Ap, const float *Bp, float *C, int ldc)
+{
+	float tile[SOD_GEMM_MAX_MR * SOD_GEMM_MAX_NR];
+	int mr = pKern->mr, nr = pKern->nr;
+	int i, j, r, c;
+	for (j = 0; j < nc; j += nr) {
+		int cols = nc - j < nr ? nc - j : nr;
+		const float *Bpanel = Bp + j*kc;
+		for (i = 0; i < mc; i += mr) {
+			int rows = mc - i < mr ? mc - i : mr;
+			const float *Apanel = Ap + i*kc;
+			if (rows == mr && cols == nr) {
+				pKern->xKernel(kc, Apanel, Bpanel, C + i*ldc + j, ldc);
+			}
+			else {
+				memset(tile, 0, sizeof(float) * mr * nr);
+				pKern->xKernel(kc, Apanel, Bpanel, tile, nr);
+				for (r = 0; r < rows; ++r) {
+					for (c = 0; c < cols; ++c) {
+						C[(i + r)*ldc + j + c] += tile[r*nr + c];
+					}
+				}
+			}
+		}
+	}
+}
+/*
+ * Blocked product of a whole problem or of one thread's band. Falls back to
+ * the reference loop if the panels cannot be allocated, which happens before
+ * anything is accumulated into C.
+ */
+static void gemm_blocked(int M, int N, int K, float ALPHA,
+	float *A, int lda,
+	float *B, int ldb,
+	float *C, int ldc)
+{
+	const sod_gemm_kernel *pKern = gemm_select_kernel();
+	int ncMax = N < SOD_GEMM_NC ? N : SOD_GEMM_NC;
+	int kcMax = K < SOD_GEMM_KC ? K : SOD_GEMM_KC;
+	float *Ap, *Bp;
+	int jc, pc, ic;
+	/* Panels are padded to whole register tiles */
+	Ap = (float *)malloc(sizeof(float) * (SOD_GEMM_MC + SOD_GEMM_MAX_MR) * kcMax);
+	Bp = (float *)malloc(sizeof(float) * (ncMax + SOD_GEMM_MAX_NR) * kcMax);
+	if (Ap == 0 || Bp == 0) {
+		free(Ap);
+		free(Bp);
+		gemm_nn_ref(M, N, K, ALPHA, A, lda, B, ldb, C, ldc);
+		return;
+	}
+	for (jc = 0; jc < N; jc += SOD_GEMM_NC) {
+		int nc = N - jc < SOD_GEMM_NC ? N - jc : SOD_GEMM_NC;
+		for (pc = 0; pc < K; pc += SOD_GEMM_KC) {
+			int kc = K - pc < SOD_GEMM_KC ? K - pc : SOD_GEMM_KC;
+			gemm_pack_b(kc, nc, B + pc*ldb + jc, ldb, pKern->nr, Bp);
+			for (ic = 0; ic < M; ic += SOD_GEMM_MC) {
+				int mc = M - ic < SOD_GEMM_MC ? M - ic : SOD_GEMM_MC;
+				gemm_pack_a(mc, kc, ALPHA, A + ic*lda + pc, lda, pKern->mr, Ap);
+				gemm_macro_kernel(pKern, mc, nc, kc, Ap, Bp, C + ic*ldc + jc, ldc);
+			}
+		}
+	}
+	free(Ap);
+	free(Bp);
+}
+#ifdef SOD_GEMM_PTHREADS
+typedef struct sod_gemm_job sod_gemm_job;
+struct sod_gemm_job {
+	int M, N, K;
+	float ALPHA;
+	float *A; int lda;
+	float *B; int ldb;
+	float *C; int ldc;
+};
+static void * gemm_thread(void *pArg)
+{
+	sod_gemm_job *pJob = (sod_gemm_job *)pArg;
+	gemm_blocked(pJob->M, pJob->N, pJob->K, pJob->ALPHA, pJob->A, pJob->lda, pJob->B, pJob->ldb, pJob->C, pJob->ldc);
+	return 0;
+}
+/*
+ * Split C into row or column bands, whichever dimension is larger, and run
+ * the blocked product of each band on its own thread. Bands are whole
+ * register tiles so no tile is shared between threads.
+ */
+static void gemm_blocked_threaded(int nThreads, int M, int N, int K, float ALPHA,
+	float *A, int lda,
+	float *B, int ldb,
+	float *C, int ldc)
+{
+	const sod_gemm_kernel *pKern = gemm_select_kernel();
+	sod_gemm_job aJob[SOD_GEMM_MAX_THREADS];
+	pthread_t aThread[SOD_GEMM_MAX_THREADS];
+	int split_n = N >= M;
+	int total = split_n ? N : M;
+	int unit = split_n ? pKern->nr : pKern->mr;
+	int units = (total + unit - 1) / unit;
+	int i, start = 0;
+	if (nThreads > units) {
+		nThreads = units;
+	}
+	for (i = 0; i < nThreads; ++i) {
+		int count = ((units * (i + 1)) / nThreads - (units * i) / nThreads) * unit;
+		if (start + count > total) {
+			count = total - start;
+		}
+		aJob[i].M = split_n ? M : count;
+		aJob[i].N = split_n ? count : N;
+		aJob[i].K = K;
+		aJob[i].ALPHA = ALPHA;
+		aJob[i].A = split_n ? A : A + start*lda;
+		aJob[i].lda = lda;
+		aJob[i].B = split_n ? B + start : B;
+		aJob[i].ldb = ldb;
+		aJob[i].C = split_n ? C + start : C + start*ldc;
+		aJob[i].ldc = ldc;
+		start += count;
+	}
+	/* The calling thread runs the first band */
+	for (i = 1; i < nThreads; ++i) {
+		if (pthread_create(&aThread[i], 0, gemm_thread, &aJob[i]) != 0) {
+			gemm_thread(&aJob[i]);
+			aThread[i] = pthread_self();
+		}
+	}
+	gemm_thread(&aJob[0]);
+	for (i = 1; i < nThreads; ++i) {
+		if (!pthread_equal(aThread[i], pthread_self())) {
+			pthread_join(aThread[i], 0);
+		}
+	}
+}
+#endif /* SOD_GEMM_PTHREADS */
+static inline void gemm_nn(int M, int N, int K, float ALPHA,
+	float *A, int lda,
+	float *B, int ldb,
+	float *C, int ldc)
+{
+	double work = (double)M * N * K;
+	if (work < SOD_GEMM_MIN_WORK || N < 4 || sod_gemm_reference) {
+		gemm_nn_ref(M, N, K, ALPHA, A, lda, B, ldb, C, ldc);
+		return;
+	}
+#ifdef SOD_GEMM_PTHREADS
+	int nMax = sod_gemm_batch_threads > 0 ? sod_gemm_batch_threads : sod_gemm_threads;
+	if (nMax > 1 && work >= 2.0 * SOD_GEMM_MIN_THREAD_WORK) {
+		int nThreads = (int)(work / SOD_GEMM_MIN_THREAD_WORK);
+		if (nThreads > nMax) {
+			nThreads = nMax;
+		}
+		gemm_blocked_threaded(nThreads, M, N, K, ALPHA, A, lda, B, ldb, C, ldc);
+		return;
+	}
+#endif /* SOD_GEMM_PTHREADS */
+	gemm_blocked(M, N, K, ALPHA, A, lda, B, ldb, C, ldc);
+}
+#else
+static inline void gemm_nn(int M, int N, int K, float ALPHA,
+	float *A, int lda,
+	float *B, int ldb,
+	float *C, int ldc)
+{
+	gemm_nn_ref(M, N, K, ALPHA, A, lda, B, ldb, C, ldc);
+}
+static int gemm_list_variants(const char **azVariant, int nMax)
+{
+	if (nMax < 1) return 0;
+	azVariant[0] = "reference";
+	return 1;
+}
+static int gemm_use_variant(const char *zVariant)
+{
+	return (zVariant == 0 || strcmp(zVariant, "reference") == 0) ? SOD_OK : SOD_UNSUPPORTED;
+}
+#endif /* SOD_BLOCKED_GEMM */
 #endif /*  SOD_EMBEDDED_COMMERCIAL_LICENSE */
 static inline void gemm_nt(int M, int N, int K, float ALPHA,
 	float *A, int lda,
@@ -4879,14 +5481,1090 @@ static inline void gradient_array(const float *x, const int n, const ACTIVATION
 		i++;
 	}
 }
+/*
+ * Convolution paths, chosen per layer when it is made (see conv_select_path()).
+ * A 1x1 stride 1 convolution reads its input as the GEMM matrix directly. A 3x3
+ * stride 1 convolution over a few channels (the input layer) is computed
+ * directly, over more channels it uses Winograd F(2x2,3x3) when the transform
+ * buffers are smaller than the im2col matrix. Everything else goes through im2col.
+ * The network workspace is sized from the path, so it only grows to the
+ * largest layer that actually needs it.
+ */
+#define SOD_CONV_IM2COL   0
+#define SOD_CONV_1X1      1
+#define SOD_CONV_WINOGRAD 2
+#define SOD_CONV_DIRECT   3
+/* Input channels up to which a 3x3 convolution is computed directly */
+#define SOD_CONV_DIRECT_MAX_C 4
+/* Output tiles transformed per GEMM batch on the Winograd path */
+#define SOD_WINOGRAD_TILES 256
+/* Gap between the 16 transformed matrices, so they do not alias in the cache */
+#define SOD_WINOGRAD_PAD 16
+
+static size_t conv_im2col_workspace(layer l)
+{
+	return (size_t)l.out_h*l.out_w*l.size*l.size*l.c * sizeof(float);
+}
+static size_t conv_winograd_workspace(layer l)
+{
+	size_t tiles = (size_t)((l.out_h + 1) / 2) * ((l.out_w + 1) / 2);
+	if (tiles > SOD_WINOGRAD_TILES) tiles = SOD_WINOGRAD_TILES;
+	/* Transformed weights, transformed input tiles and their products */
+	return 16 * ((size_t)l.n*l.c + ((size_t)l.c + l.n) * tiles + 2 * SOD_WINOGRAD_PAD) * sizeof(float);
+}
+static int conv_select_path(layer l)
+{
+	if (l.size == 1 && l.stride == 1 && l.pad == 0) {
+		return SOD_CONV_1X1;
+	}
+	if (l.size == 3 && l.stride == 1 && l.out_h > 0 && l.out_w > 0) {
+		if (l.c <= SOD_CONV_DIRECT_MAX_C) {
+			return SOD_CONV_DIRECT;
+		}
+		if (conv_winograd_workspace(l) < conv_im2col_workspace(l)) {
+			return SOD_CONV_WINOGRAD;
+		}
+	}
+	return SOD_CONV_IM2COL;
+}
+/* U = G g G^T for every filter, stored as 16 matrices of n x c */
+static void winograd_transform_weights(const float *weights, int n, int c, float *U)
+{
+	int k, ci, i, j;
+	for (k = 0; k < n; ++k) {
+		for (ci = 0; ci < c; ++ci) {
+			const float *g = weights + ((size_t)k*c + ci) * 9;
+			float t[4][3], u[4][4];
+			for (j = 0; j < 3; ++j) {
+				t[0][j] = g[j];
+				t[1][j] = 0.5f * (g[j] + g[3 + j] + g[6 + j]);
+				t[2][j] = 0.5f * (g[j] - g[3 + j] + g[6 + j]);
+				t[3][j] = g[6 + j];
+			}
+			for (i = 0; i < 4; ++i) {
+				u[i][0] = t[i][0];
+				u[i][1] = 0.5f * (t[i][0] + t[i][1] + t[i][2]);
+				u[i][2] = 0.5f * (t[i][0] - t[i][1] + t[i][2]);
+				u[i][3] = t[i][2];
+			}
+			for (i = 0; i < 16; ++i) {
+				U[((size_t)i*n + k)*c + ci] = u[i / 4][i % 4];
+			}
+		}
+	}
+}
+/* V = B^T d B for tiles t0 .. t0+tb-1, stored as 16 matrices of c x tb, vs apart */
+static void winograd_transform_input(const float *im, int c, int h, int w, int pad,
+	int tiles_w, int t0, int tb, size_t vs, float *V)
+{
+	int ci, t, i, j;
+	for (ci = 0; ci < c; ++ci) {
+		const float *plane = im + (size_t)ci*h*w;
+		for (t = 0; t < tb; ++t) {
+			int row = ((t0 + t) / tiles_w) * 2 - pad;
+			int col = ((t0 + t) % tiles_w) * 2 - pad;
+			float d[4][4], s[4][4];
+			for (i = 0; i < 4; ++i) {
+				int y = row + i;
+				for (j = 0; j < 4; ++j) {
+					int x = col + j;
+					d[i][j] = (y >= 0 && y < h && x >= 0 && x < w) ? plane[y*w + x] : 0;
+				}
+			}
+			for (j = 0; j < 4; ++j) {
+				s[0][j] = d[0][j] - d[2][j];
+				s[1][j] = d[1][j] + d[2][j];
+				s[2][j] = d[2][j] - d[1][j];
+				s[3][j] = d[1][j] - d[3][j];
+			}
+			for (i = 0; i < 4; ++i) {
+				V[(i * 4 + 0)*vs + (size_t)ci*tb + t] = s[i][0] - s[i][2];
+				V[(i * 4 + 1)*vs + (size_t)ci*tb + t] = s[i][1] + s[i][2];
+				V[(i * 4 + 2)*vs + (size_t)ci*tb + t] = s[i][2] - s[i][1];
+				V[(i * 4 + 3)*vs + (size_t)ci*tb + t] = s[i][1] - s[i][3];
+			}
+		}
+	}
+}
+/* Y = A^T m A for tiles t0 .. t0+tb-1 of 16 matrices ms apart, cropped to the output plane */
+static void winograd_transform_output(const float *M, int n, int out_h, int out_w,
+	int tiles_w, int t0, int tb, size_t ms, float *output)
+{
+	int k, t, i, j;
+	for (k = 0; k < n; ++k) {
+		float *plane = output + (size_t)k*out_h*out_w;
+		for (t = 0; t < tb; ++t) {
+			int row = ((t0 + t) / tiles_w) * 2;
+			int col = ((t0 + t) % tiles_w) * 2;
+			float m[4][4], s[2][4], y[2][2];
+			for (i = 0; i < 16; ++i) {
+				m[i / 4][i % 4] = M[i*ms + (size_t)k*tb + t];
+			}
+			for (j = 0; j < 4; ++j) {
+				s[0][j] = m[0][j] + m[1][j] + m[2][j];
+				s[1][j] = m[1][j] - m[2][j] - m[3][j];
+			}
+			for (i = 0; i < 2; ++i) {
+				y[i][0] = s[i][0] + s[i][1] + s[i][2];
+				y[i][1] = s[i][1] - s[i][2] - s[i][3];
+			}
+			for (i = 0; i < 2 && row + i < out_h; ++i) {
+				for (j = 0; j < 2 && col + j < out_w; ++j) {
+					plane[(row + i)*out_w + col + j] = y[i][j];
+				}
+			}
+		}
+	}
+}
+/* y += ALPHA * x over a row; the rows never overlap, and the unrolled body vectorizes at -O2 */
+static inline void conv_row_axpy(int n, float ALPHA, const float *__restrict x, float *__restrict y)
+{
+	int i = 0;
+	for (; i + 4 <= n; i += 4) {
+		y[i] += ALPHA * x[i];
+		y[i + 1] += ALPHA * x[i + 1];
+		y[i + 2] += ALPHA * x[i + 2];
+		y[i + 3] += ALPHA * x[i + 3];
+	}
+	for (; i < n; ++i) {
+		y[i] += ALPHA * x[i];
+	}
+}
+/* 3x3 stride 1 convolution, one output row at a time so the row stays in cache */
+static void forward_convolution_direct(convolutional_layer l, const float *input, float *output)
+{
+	int k, ci, y, dy, dx;
+	for (k = 0; k < l.n; ++k) {
+		const float *wk = l.weights + (size_t)k*l.c * 9;
+		for (y = 0; y < l.out_h; ++y) {
+			float *out = output + ((size_t)k*l.out_h + y)*l.out_w;
+			for (ci = 0; ci < l.c; ++ci) {
+				const float *plane = input + (size_t)ci*l.h*l.w;
+				for (dy = 0; dy < 3; ++dy) {
+					int iy = y + dy - l.pad;
+					if (iy < 0 || iy >= l.h) continue;
+					for (dx = 0; dx < 3; ++dx) {
+						float wv = wk[ci * 9 + dy * 3 + dx];
+						int x0 = l.pad - dx > 0 ? l.pad - dx : 0;
+						int x1 = l.w + l.pad - dx < l.out_w ? l.w + l.pad - dx : l.out_w;
+						if (x1 > x0) {
+							conv_row_axpy(x1 - x0, wv, plane + (size_t)iy*l.w + x0 + dx - l.pad, out + x0);
+						}
+					}
+				}
+			}
+		}
+	}
+}
+static void forward_convolution_winograd(convolutional_layer l, float *input, float *output, float *workspace)
+{
+	int tiles_w = (l.out_w + 1) / 2;
+	int tiles = tiles_w * ((l.out_h + 1) / 2);
+	int chunk = tiles < SOD_WINOGRAD_TILES ? tiles : SOD_WINOGRAD_TILES;
+	size_t vs = (size_t)l.c*chunk + SOD_WINOGRAD_PAD;
+	size_t ms = (size_t)l.n*chunk + SOD_WINOGRAD_PAD;
+	float *U = workspace;
+	float *V = U + (size_t)16 * l.n*l.c;
+	float *M = V + 16 * vs;
+	int t0, i;
+
+	winograd_transform_weights(l.weights, l.n, l.c, U);
+	for (t0 = 0; t0 < tiles; t0 += chunk) {
+		int tb = tiles - t0 < chunk ? tiles - t0 : chunk;
+		winograd_transform_input(input, l.c, l.h, l.w, l.pad, tiles_w, t0, tb, vs, V);
+		for (i = 0; i < 16; ++i) {
+			fill_cpu(l.n*tb, 0, M + i * ms, 1);
+			gemm(0, 0, l.n, tb, l.c, 1, U + (size_t)i*l.n*l.c, l.c,
+				V + i * vs, tb, 1, M + i * ms, tb);
+		}
+		winograd_transform_output(M, l.n, l.out_h, l.out_w, tiles_w, t0, tb, ms, output);
+	}
+}
+/*
+ * Int8 convolution (SOD_CNN_INT8_MODEL).
+ *
+ * Weights are quantized per filter and the layer input per tensor, both
+ * symmetric and saturated at +-127, with the input step calibrated offline
+ * (SOD_CNN_INT8_CALIBRATE, then sod_cnn_save_int8()). The input is quantized
+ * once and unrolled into int8 patches, one row of k values per output pixel
+ * zero padded to a multiple of SOD_Q8_ALIGN, a few hundred KB at a time. Each
+ * output is the int32 dot product of a filter with a patch scaled back to
+ * float. The dot kernel is picked once from the CPU: AVX2 maddubs on x86,
+ * sdot or widening multiplies on ARM NEON, and a portable loop otherwise.
+ */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define SOD_Q8_X86
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define SOD_Q8_NEON
+#endif
+#define SOD_Q8_MAX 127
+/* Patch rows are padded to this many values so the kernels have no tail */
+#define SOD_Q8_ALIGN 32
+/* Bytes of patches unrolled per pass over the weights */
+#define SOD_Q8_PATCH_BYTES (256 * 1024)
+/* Patches per dot kernel call */
+#define SOD_Q8_NR 4
+typedef void(*ProcQ8Dot)(int kp, const signed char *pW, const signed char *pP, int32_t *pOut);
+
+static inline int q8_padded(int k)
+{
+	return (k + SOD_Q8_ALIGN - 1) / SOD_Q8_ALIGN * SOD_Q8_ALIGN;
+}
+static inline signed char q8_quantize(float x, float inv_step)
+{
+	float q = x * inv_step;
+	q = (q > 0) ? q + .5f : q - .5f;
+	if (q > SOD_Q8_MAX) q = SOD_Q8_MAX;
+	if (q < -SOD_Q8_MAX) q = -SOD_Q8_MAX;
+	return (signed char)q;
+}
+/* pOut[j] = pW . pP[j], for the SOD_Q8_NR patches of kp values at pP */
+static void q8_dot_ref(int kp, const signed char *pW, const signed char *pP, int32_t *pOut)
+{
+	int i, j;
+	for (j = 0; j < SOD_Q8_NR; ++j) {
+		const signed char *p = pP + (size_t)j*kp;
+		int32_t sum = 0;
+		for (i = 0; i < kp; ++i) {
+			sum += (int32_t)pW[i] * p[i];
+		}
+		pOut[j] = sum;
+	}
+}
+#ifdef SOD_Q8_X86
+__attribute__((target("avx2")))
+static inline __m256i q8_madd_avx2(__m256i aw, __m256i w, const signed char *p, __m256i acc)
+{
+	/* maddubs takes one unsigned operand: |w| times p with the sign of w */
+	__m256i sp = _mm256_sign_epi8(_mm256_loadu_si256((const __m256i *)p), w);
+	__m256i s16 = _mm256_maddubs_epi16(aw, sp);
+	return _mm256_add_epi32(acc, _mm256_madd_epi16(s16, _mm256_set1_epi16(1)));
+}
+__attribute__((target("avx2")))
+static inline int32_t q8_hsum_avx2(__m256i v)
+{
+	__m128i s = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+	s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4E));
+	s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xB1));
+	return _mm_cvtsi128_si32(s);
+}
+__attribute__((target("avx2")))
+static void q8_dot_avx2(int kp, const signed char *pW, const signed char *pP, int32_t *pOut)
+{
+	__m256i acc0 = _mm256_setzero_si256();
+	__m256i acc1 = _mm256_setzero_si256();
+	__m256i acc2 = _mm256_setzero_si256();
+	__m256i acc3 = _mm256_setzero_si256();
+	int i;
+	for (i = 0; i < kp; i += 32) {
+		__m256i w = _mm256_loadu_si256((const __m256i *)(pW + i));
+		__m256i aw = _mm256_sign_epi8(w, w);
+		acc0 = q8_madd_avx2(aw, w, pP + i, acc0);
+		acc1 = q8_madd_avx2(aw, w, pP + kp + i, acc1);
+		acc2 = q8_madd_avx2(aw, w, pP + 2 * kp + i, acc2);
+		acc3 = q8_madd_avx2(aw, w, pP + 3 * kp + i, acc3);
+	}
+	pOut[0] = q8_hsum_avx2(acc0);
+	pOut[1] = q8_hsum_avx2(acc1);
+	pOut[2] = q8_hsum_avx2(acc2);
+	pOut[3] = q8_hsum_avx2(acc3);
+}
+#endif /* SOD_Q8_X86 */
+#ifdef SOD_Q8_NEON
+static void q8_dot_neon(int kp, const signed char *pW, const signed char *pP, int32_t *pOut)
+{
+	int32x4_t acc[SOD_Q8_NR];
+	int i, j;
+	for (j = 0; j < SOD_Q8_NR; ++j) {
+		acc[j] = vdupq_n_s32(0);
+	}
+	for (i = 0; i < kp; i += 16) {
+		int8x16_t w = vld1q_s8(pW + i);
+		for (j = 0; j < SOD_Q8_NR; ++j) {
+			int8x16_t p = vld1q_s8(pP + (size_t)j*kp + i);
+#if defined(__ARM_FEATURE_DOTPROD)
+			acc[j] = vdotq_s32(acc[j], w, p);
+#else
+			/* 127 * 127 fits an int16 lane, pairs are widened to int32 */
+			acc[j] = vpadalq_s16(acc[j], vmull_s8(vget_low_s8(w), vget_low_s8(p)));
+			acc[j] = vpadalq_s16(acc[j], vmull_s8(vget_high_s8(w), vget_high_s8(p)));
+#endif
+		}
+	}
+	for (j = 0; j < SOD_Q8_NR; ++j) {
+#if defined(__aarch64__)
+		pOut[j] = vaddvq_s32(acc[j]);
+#else
+		int32x2_t s = vadd_s32(vget_low_s32(acc[j]), vget_high_s32(acc[j]));
+		pOut[j] = vget_lane_s32(vpadd_s32(s, s), 0);
+#endif
+	}
+}
+#endif /* SOD_Q8_NEON */
+static ProcQ8Dot q8_select_kernel(void)
+{
+	/* Idempotent, so concurrent first calls only race to the same answer */
+	static ProcQ8Dot xDot = 0;
+	if (xDot) {
+		return xDot;
+	}
+#if defined(SOD_Q8_X86)
+	__builtin_cpu_init();
+	xDot = __builtin_cpu_supports("avx2") ? q8_dot_avx2 : q8_dot_ref;
+#elif defined(SOD_Q8_NEON)
+	xDot = q8_dot_neon;
+#else
+	xDot = q8_dot_ref;
+#endif
+	return xDot;
+}
+/* Patches unrolled per pass: as many as fit SOD_Q8_PATCH_BYTES, a multiple of SOD_Q8_NR */
+static int q8_patch_count(int kp, int n)
+{
+	int nb = SOD_Q8_PATCH_BYTES / kp;
+	int nmax = (n + SOD_Q8_NR - 1) / SOD_Q8_NR * SOD_Q8_NR;
+	nb -= nb % SOD_Q8_NR;
+	if (nb < SOD_Q8_NR) nb = SOD_Q8_NR;
+	if (nb > nmax) nb = nmax;
+	return nb;
+}
+static size_t conv_q8_workspace(layer l)
+{
+	int kp = q8_padded(l.size*l.size*l.c);
+	/* The quantized input, then the patches */
+	return (size_t)l.c*l.h*l.w + (size_t)q8_patch_count(kp, l.out_h*l.out_w) * kp;
+}
+/* Unroll patches j0 .. j0+jn-1 of the quantized input, zeroing rows jn .. jp-1 */
+static void q8_unroll_patches(convolutional_layer l, const signed char *pIn, int j0, int jn, int jp, int kp, signed char *pPatch)
+{
+	int j, ci, dy, dx;
+	for (j = 0; j < jp; ++j) {
+		signed char *p = pPatch + (size_t)j*kp;
+		int oy, ox, kk = 0;
+		if (j >= jn) {
+			memset(p, 0, kp);
+			continue;
+		}
+		oy = (j0 + j) / l.out_w;
+		ox = (j0 + j) % l.out_w;
+		for (ci = 0; ci < l.c; ++ci) {
+			const signed char *plane = pIn + (size_t)ci*l.h*l.w;
+			for (dy = 0; dy < l.size; ++dy) {
+				int iy = oy * l.stride + dy - l.pad;
+				for (dx = 0; dx < l.size; ++dx) {
+					int ix = ox * l.stride + dx - l.pad;
+					p[kk++] = (iy >= 0 && iy < l.h && ix >= 0 && ix < l.w) ? plane[iy*l.w + ix] : 0;
+				}
+			}
+		}
+		memset(p + kk, 0, kp - kk);
+	}
+}
+static void forward_convolution_q8(convolutional_layer l, const float *input, float *output, float *workspace)
+{
+	ProcQ8Dot xDot = q8_select_kernel();
+	int kp = q8_padded(l.size*l.size*l.c);
+	int n = l.out_h*l.out_w;
+	int nb = q8_patch_count(kp, n);
+	size_t in_size = (size_t)l.c*l.h*l.w;
+	signed char *pIn = (signed char *)workspace;
+	signed char *pPatch = pIn + in_size;
+	float inv_step = 1.f / l.input_scale_q8;
+	int32_t acc[SOD_Q8_NR];
+	size_t i;
+	int j0, j, f, r;
+
+	for (i = 0; i < in_size; ++i) {
+		pIn[i] = q8_quantize(input[i], inv_step);
+	}
+	for (j0 = 0; j0 < n; j0 += nb) {
+		int jn = n - j0 < nb ? n - j0 : nb;
+		int jp = (jn + SOD_Q8_NR - 1) / SOD_Q8_NR * SOD_Q8_NR;
+		q8_unroll_patches(l, pIn, j0, jn, jp, kp, pPatch);
+		for (f = 0; f < l.n; ++f) {
+			const signed char *pW = l.weights_q8 + (size_t)f*kp;
+			float step = l.scales_q8[f] * l.input_scale_q8;
+			float *out = output + (size_t)f*n + j0;
+			for (j = 0; j < jn; j += SOD_Q8_NR) {
+				int nr = jn - j < SOD_Q8_NR ? jn - j : SOD_Q8_NR;
+				xDot(kp, pW, pPatch + (size_t)j*kp, acc);
+				for (r = 0; r < nr; ++r) {
+					out[j + r] = acc[r] * step;
+				}
+			}
+		}
+	}
+}
+/*
+ * Int8 model file written by sod_cnn_save_int8() and read by SOD_CNN_INT8_MODEL:
+ * a header (magic, version, layer count of the network, record count) followed
+ * by one record per quantized convolutional layer: layer index, filters n, filter
+ * size k, input step, n filter steps and n x k int8 weights.
+ */
+#define SOD_Q8_MAGIC 0x51444f53 /* "SODQ" */
+#define SOD_Q8_VERSION 1
+static int save_q8_weights(network *net, const char *zPath)
+{
+	int i, f, j, first = -1, last = -1, count = 0;
+	int32_t hdr[4];
+	signed char *q;
+	float *steps;
+	FILE *fp;
+	/* The input and output layers stay in float, they carry most of the error */
+	for (i = 0; i < net->n; ++i) {
+		layer *l = &net->layers[i];
+		if (l->type != CONVOLUTIONAL || l->binary || l->xnor || !l->weights) continue;
+		if (first < 0) first = i;
+		last = i;
+	}
+	for (i = first + 1; i < last; ++i) {
+		layer *l = &net->layers[i];
+		if (l->type == CONVOLUTIONAL && !l->binary && !l->xnor && l->weights && l->input_absmax > 0) count++;
+	}
+	if (count < 1) {
+		net->pNet->zErr = "No calibrated convolutional layer to quantize";
+		return SOD_UNSUPPORTED;
+	}
+	fp = fopen(zPath, "wb");
+	if (!fp) {
+		net->pNet->zErr = "Cannot create int8 model";
+		return SOD_IOERR;
+	}
+	hdr[0] = SOD_Q8_MAGIC;
+	hdr[1] = SOD_Q8_VERSION;
+	hdr[2] = net->n;
+	hdr[3] = count;
+	fwrite(hdr, sizeof(int32_t), 4, fp);
+	for (i = first + 1; i < last; ++i) {
+		layer *l = &net->layers[i];
+		int k = l->c*l->size*l->size;
+		int32_t rec[3];
+		float in_step;
+		if (l->type != CONVOLUTIONAL || l->binary || l->xnor || !l->weights || l->input_absmax <= 0) continue;
+		q = malloc((size_t)l->n * k);
+		steps = malloc(l->n * sizeof(float));
+		if (!q || !steps) {
+			free(q);
+			free(steps);
+			fclose(fp);
+			return SOD_OUTOFMEM;
+		}
+		for (f = 0; f < l->n; ++f) {
+			const float *w = l->weights + (size_t)f*k;
+			float absmax = 0;
+			for (j = 0; j < k; ++j) {
+				if (fabsf(w[j]) > absmax) absmax = fabsf(w[j]);
+			}
+			steps[f] = absmax > 0 ? absmax / SOD_Q8_MAX : 1.f;
+			for (j = 0; j < k; ++j) {
+				q[(size_t)f*k + j] = q8_quantize(w[j], 1.f / steps[f]);
+			}
+		}
+		rec[0] = i;
+		rec[1] = l->n;
+		rec[2] = k;
+		in_step = l->input_absmax / SOD_Q8_MAX;
+		fwrite(rec, sizeof(int32_t), 3, fp);
+		fwrite(&in_step, sizeof(float), 1, fp);
+		fwrite(steps, sizeof(float), l->n, fp);
+		fwrite(q, 1, (size_t)l->n * k, fp);
+		free(q);
+		free(steps);
+	}
+	if (fclose(fp) != 0) {
+		net->pNet->zErr = "Error writing int8 model";
+		return SOD_IOERR;
+	}
+	return SOD_OK;
+}
+static int load_q8_weights(network *net, const char *zPath)
+{
+	signed char **aWeights;
+	float **aSteps, *aInStep;
+	size_t need = net->workspace_size;
+	int32_t hdr[4], rec[3];
+	int i, f, rc = SOD_OK;
+	FILE *fp = fopen(zPath, "rb");
+	if (!fp) {
+		net->pNet->zErr = "Cannot open int8 model";
+		return SOD_IOERR;
+	}
+	if (fread(hdr, sizeof(int32_t), 4, fp) != 4 || hdr[0] != SOD_Q8_MAGIC || hdr[1] != SOD_Q8_VERSION || hdr[2] != net->n) {
+		fclose(fp);
+		net->pNet->zErr = "Int8 model does not match the network";
+		return SOD_UNSUPPORTED;
+	}
+	aWeights = calloc(net->n, sizeof(signed char *));
+	aSteps = calloc(net->n, sizeof(float *));
+	aInStep = calloc(net->n, sizeof(float));
+	if (!aWeights || !aSteps || !aInStep) {
+		rc = SOD_OUTOFMEM;
+		goto done;
+	}
+	/* Read every record before touching the network, so a bad file changes nothing */
+	for (i = 0; i < hdr[3]; ++i) {
+		layer *l;
+		int k, kp;
+		if (fread(rec, sizeof(int32_t), 3, fp) != 3 || rec[0] < 0 || rec[0] >= net->n) {
+			rc = SOD_UNSUPPORTED;
+			goto done;
+		}
+		l = &net->layers[rec[0]];
+		k = l->c*l->size*l->size;
+		kp = q8_padded(k);
+		if (l->type != CONVOLUTIONAL || l->binary || l->xnor || rec[1] != l->n || rec[2] != k || aWeights[rec[0]]) {
+			rc = SOD_UNSUPPORTED;
+			goto done;
+		}
+		aWeights[rec[0]] = calloc((size_t)l->n, kp);
+		aSteps[rec[0]] = malloc(l->n * sizeof(float));
+		if (!aWeights[rec[0]] || !aSteps[rec[0]]) {
+			rc = SOD_OUTOFMEM;
+			goto done;
+		}
+		if (fread(&aInStep[rec[0]], sizeof(float), 1, fp) != 1 || !(aInStep[rec[0]] > 0) ||
+			fread(aSteps[rec[0]], sizeof(float), l->n, fp) != (size_t)l->n) {
+			rc = SOD_UNSUPPORTED;
+			goto done;
+		}
+		for (f = 0; f < l->n; ++f) {
+			if (fread(aWeights[rec[0]] + (size_t)f*kp, 1, k, fp) != (size_t)k) {
+				rc = SOD_UNSUPPORTED;
+				goto done;
+			}
+		}
+		if (conv_q8_workspace(*l) > need) need = conv_q8_workspace(*l);
+	}
+	if (need > net->workspace_size) {
+		float *pWork = calloc(1, need);
+		if (!pWork) {
+			rc = SOD_OUTOFMEM;
+			goto done;
+		}
+		free(net->workspace);
+		net->workspace = pWork;
+		net->workspace_size = need;
+	}
+	for (i = 0; i < net->n; ++i) {
+		layer *l = &net->layers[i];
+		if (!aWeights[i]) continue;
+		/* The float weights are no longer needed, which is most of the saving */
+#ifdef SOD_OPENCL
+		sod_cl_release_weights(l->weights);
+#endif /* SOD_OPENCL */
+		free(l->weights);
+		l->weights = 0;
+		l->weights_q8 = aWeights[i];
+		l->scales_q8 = aSteps[i];
+		l->input_scale_q8 = aInStep[i];
+		aWeights[i] = 0;
+		aSteps[i] = 0;
+	}
+done:
+	if (rc != SOD_OK) {
+		net->pNet->zErr = rc == SOD_OUTOFMEM ? "Out of memory loading int8 model" : "Malformed int8 model";
+	}
+	for (i = 0; aWeights && aSteps && i < net->n; ++i) {
+		free(aWeights[i]);
+		free(aSteps[i]);
+	}
+	free(aWeights);
+	free(aSteps);
+	free(aInStep);
+	fclose(fp);
+	return rc;
+}
+/* Add the bias and apply the activation in a single pass over an output plane */
+static inline void conv_bias_activate(float *x, int n, float bias, ACTIVATION a)
+{
+	int j;
+	switch (a) {
+	case LEAKY:
+		for (j = 0; j < n; ++j) {
+			float v = x[j] + bias;
+			x[j] = (v > 0) ? v : .1f * v;
+		}
+		break;
+	case RELU:
+		for (j = 0; j < n; ++j) {
+			float v = x[j] + bias;
+			x[j] = (v > 0) ? v : 0;
+		}
+		break;
+	case LINEAR:
+		for (j = 0; j < n; ++j) {
+			x[j] += bias;
+		}
+		break;
+	default:
+		for (j = 0; j < n; ++j) {
+			x[j] = activate(x[j] + bias, a);
+		}
+		break;
+	}
+}
+/*
+ * Deep layers of a detection network hold most of its weights but only a few
+ * output positions, so streaming the weights costs more than the arithmetic.
+ * When several images go through the network at once (sod_cnn_predict_batch()),
+ * the im2col matrices of a group of images are laid side by side and
+ * multiplied in one product, loading each weight once for the whole group.
+ * Layers whose weights are smaller than an image's im2col matrix keep going
+ * image by image. The group is sized so its matrices fit this many bytes.
+ */
+#define SOD_CONV_BATCH_WORKSPACE (16 << 20)
+
+/* Images convolved per product, 1 when the layer runs image by image */
+static int conv_batch_group(layer l)
+{
+	size_t k = (size_t)l.size*l.size*l.c, n = (size_t)l.out_h*l.out_w;
+	size_t per_image;
+	int g;
+	if (l.batch < 2 || l.weights_q8 || l.binary || l.xnor || (size_t)l.n <= n) {
+		return 1;
+	}
+	if (l.conv_path != SOD_CONV_IM2COL && l.conv_path != SOD_CONV_1X1) {
+		return 1;
+	}
+	/* The side by side im2col matrices and the product before it is split per image */
+	per_image = (k + l.n) * n * sizeof(float);
+	g = (int)(SOD_CONV_BATCH_WORKSPACE / per_image);
+	if (g > l.batch) g = l.batch;
+	return g < 2 ? 1 : g;
+}
+static size_t conv_batch_workspace(layer l)
+{
+	int g = conv_batch_group(l);
+	if (g < 2) {
+		return 0;
+	}
+	return (size_t)g * ((size_t)l.size*l.size*l.c + l.n) * l.out_h*l.out_w * sizeof(float);
+}
+static void forward_convolution_batched(convolutional_layer l, float *input, float *output, float *workspace, int nb)
+{
+	int m = l.n, k = l.size*l.size*l.c, n = l.out_h*l.out_w;
+	int ld = nb * n;
+	float *b = workspace;
+	float *c = workspace + (size_t)k*ld;
+	int j, r;
+	for (j = 0; j < nb; ++j) {
+		float *im = input + (size_t)j*l.c*l.h*l.w;
+		if (l.conv_path == SOD_CONV_1X1) {
+			for (r = 0; r < k; ++r) {
+				memcpy(b + (size_t)r*ld + j*n, im + (size_t)r*n, n * sizeof(float));
+			}
+		}
+		else {
+			im2col_cpu_ld(im, l.c, l.h, l.w, l.size, l.stride, l.pad, b + j*n, ld);
+		}
+	}
+	fill_cpu(m*ld, 0, c, 1);
+	gemm(0, 0, m, ld, k, 1, l.weights, k, b, ld, 1, c, ld);
+	for (j = 0; j < nb; ++j) {
+		for (r = 0; r < m; ++r) {
+			memcpy(output + ((size_t)j*m + r)*n, c + (size_t)r*ld + j*n, n * sizeof(float));
+		}
+	}
+}
+#ifdef SOD_OPENCL
+/*
+ * OpenCL backend for the forward pass of convolutional and maxpool layers.
+ *
+ * libOpenCL is opened at run time, so a SOD_OPENCL build still runs, on the
+ * CPU, where no OpenCL driver is installed. Networks opt in with
+ * SOD_CNN_OPENCL. The first GPU found is shared by every network of the
+ * process and runs one layer at a time.
+ *
+ * The weights of a convolutional layer are uploaded on its first forward
+ * pass, with batch normalization folded into a scale and a shift per filter,
+ * and stay on the device until the network owning them is freed. Networks
+ * sharing weights share the upload. Layer inputs and outputs are wrapped
+ * with CL_MEM_USE_HOST_PTR, so GPUs on unified memory (Mali, Adreno, Intel)
+ * read and write them in place instead of copying.
+ *
+ * Layers the kernels do not cover (binary or int8 weights, activations other
+ * than linear, leaky, relu and logistic) or too small to be worth a dispatch
+ * run on the CPU as before. After an OpenCL error the backend is disabled
+ * for the process and every layer runs on the CPU.
+ */
+#define CL_TARGET_OPENCL_VERSION 120
+#include <CL/cl.h>
+#include <dlfcn.h>
+#include <pthread.h>
+/* Convolutions below this many multiply-adds stay on the CPU */
+#define SOD_CL_MIN_WORK (1 << 20)
+/* Work items of a group along the output positions */
+#define SOD_CL_GROUP 64
+static const char zClKernels[] =
+"__kernel void conv_forward(__global const float *in, __global const float *w,\n"
+"	__global const float *mul, __global const float *add, __global float *out,\n"
+"	int c, int h, int wd, int size, int stride, int pad, int out_h, int out_w, int act)\n"
+"{\n"
+"	int p = get_global_id(0), f = get_global_id(1), b = get_global_id(2);\n"
+"	int n = get_global_size(1);\n"
+"	int oy, ox, ch, ky, kx;\n"
+"	float sum = 0;\n"
+"	if (p >= out_h * out_w) return;\n"
+"	oy = p / out_w;\n"
+"	ox = p % out_w;\n"
+"	in += b * c * h * wd;\n"
+"	w += f * c * size * size;\n"
+"	for (ch = 0; ch < c; ++ch) {\n"
+"		for (ky = 0; ky < size; ++ky) {\n"
+"			int iy = oy * stride - pad + ky;\n"
+"			if (iy < 0 || iy >= h) continue;\n"
+"			for (kx = 0; kx < size; ++kx) {\n"
+"				int ix = ox * stride - pad + kx;\n"
+"				if (ix >= 0 && ix < wd) sum += w[(ch * size + ky) * size + kx] * in[(ch * h + iy) * wd + ix];\n"
+"			}\n"
+"		}\n"
+"	}\n"
+"	sum = sum * mul[f] + add[f];\n"
+"	if (act == 1) sum = sum > 0 ? sum : .1f * sum;\n"
+"	else if (act == 2) sum = sum > 0 ? sum : 0;\n"
+"	else if (act == 3) sum = 1.f / (1.f + exp(-sum));\n"
+"	out[(b * n + f) * out_h * out_w + p] = sum;\n"
+"}\n"
+"__kernel void maxpool_forward(__global const float *in, __global float *out,\n"
+"	int h, int wd, int size, int stride, int pad, int out_h, int out_w)\n"
+"{\n"
+"	int p = get_global_id(0), k = get_global_id(1);\n"
+"	int oy, ox, n, m;\n"
+"	float best = -FLT_MAX;\n"
+"	if (p >= out_h * out_w) return;\n"
+"	oy = p / out_w;\n"
+"	ox = p % out_w;\n"
+"	in += k * h * wd;\n"
+"	for (n = 0; n < size; ++n) {\n"
+"		int iy = oy * stride - pad + n;\n"
+"		if (iy < 0 || iy >= h) continue;\n"
+"		for (m = 0; m < size; ++m) {\n"
+"			int ix = ox * stride - pad + m;\n"
+"			if (ix >= 0 && ix < wd) best = fmax(best, in[iy * wd + ix]);\n"
+"		}\n"
+"	}\n"
+"	out[k * out_h * out_w + p] = best;\n"
+"}\n";
+typedef struct sod_cl_weights sod_cl_weights;
+struct sod_cl_weights {
+	const float *weights; /* Host weights the entry was uploaded from */
+	cl_mem w;
+	cl_mem mul;
+	cl_mem add;
+	sod_cl_weights *pNext;
+};
+static struct {
+	int state; /* 0: not opened yet, 1: ready, -1: unavailable or failed */
+	void *handle;
+	cl_context ctx;
+	cl_command_queue queue;
+	cl_program program;
+	cl_kernel conv;
+	cl_kernel maxpool;
+	sod_cl_weights *pWeights;
+	cl_int(*GetPlatformIDs)(cl_uint, cl_platform_id *, cl_uint *);
+	cl_int(*GetDeviceIDs)(cl_platform_id, cl_device_type, cl_uint, cl_device_id *, cl_uint *);
+	cl_context(*CreateContext)(const cl_context_properties *, cl_uint, const cl_device_id *,
+		void (CL_CALLBACK *)(const char *, const void *, size_t, void *), void *, cl_int *);
+	cl_command_queue(*CreateCommandQueue)(cl_context, cl_device_id, cl_command_queue_properties, cl_int *);
+	cl_program(*CreateProgramWithSource)(cl_context, cl_uint, const char **, const size_t *, cl_int *);
+	cl_int(*BuildProgram)(cl_program, cl_uint, const cl_device_id *, const char *,
+		void (CL_CALLBACK *)(cl_program, void *), void *);
+	cl_kernel(*CreateKernel)(cl_program, const char *, cl_int *);
+	cl_mem(*CreateBuffer)(cl_context, cl_mem_flags, size_t, void *, cl_int *);
+	cl_int(*SetKernelArg)(cl_kernel, cl_uint, size_t, const void *);
+	cl_int(*EnqueueNDRangeKernel)(cl_command_queue, cl_kernel, cl_uint, const size_t *, const size_t *,
+		const size_t *, cl_uint, const cl_event *, cl_event *);
+	void *(*EnqueueMapBuffer)(cl_command_queue, cl_mem, cl_bool, cl_map_flags, size_t, size_t,
+		cl_uint, const cl_event *, cl_event *, cl_int *);
+	cl_int(*EnqueueUnmapMemObject)(cl_command_queue, cl_mem, void *, cl_uint, const cl_event *, cl_event *);
+	cl_int(*Finish)(cl_command_queue);
+	cl_int(*ReleaseMemObject)(cl_mem);
+} sod_cl;
+static pthread_mutex_t sod_cl_mutex = PTHREAD_MUTEX_INITIALIZER;
+/* Called with sod_cl_mutex held */
+static int sod_cl_init(void)
+{
+	cl_platform_id aPlatform[8];
+	cl_device_id device = 0;
+	cl_uint nPlatform = 0, i;
+	const char *zSrc = zClKernels;
+	cl_int err;
+	void *handle;
+	handle = dlopen("libOpenCL.so.1", RTLD_LAZY);
+	if (!handle) {
+		handle = dlopen("libOpenCL.so", RTLD_LAZY);
+		if (!handle) return SOD_UNSUPPORTED;
+	}
+	sod_cl.handle = handle;
+#define SOD_CL_SYM(NAME) if ((*(void **)&sod_cl.NAME = dlsym(handle, "cl" #NAME)) == 0) return SOD_UNSUPPORTED
+	SOD_CL_SYM(GetPlatformIDs);
+	SOD_CL_SYM(GetDeviceIDs);
+	SOD_CL_SYM(CreateContext);
+	SOD_CL_SYM(CreateCommandQueue);
+	SOD_CL_SYM(CreateProgramWithSource);
+	SOD_CL_SYM(BuildProgram);
+	SOD_CL_SYM(CreateKernel);
+	SOD_CL_SYM(CreateBuffer);
+	SOD_CL_SYM(SetKernelArg);
+	SOD_CL_SYM(EnqueueNDRangeKernel);
+	SOD_CL_SYM(EnqueueMapBuffer);
+	SOD_CL_SYM(EnqueueUnmapMemObject);
+	SOD_CL_SYM(Finish);
+	SOD_CL_SYM(ReleaseMemObject);
+#undef SOD_CL_SYM
+	if (sod_cl.GetPlatformIDs(8, aPlatform, &nPlatform) != CL_SUCCESS) return SOD_UNSUPPORTED;
+	if (nPlatform > 8) nPlatform = 8;
+	for (i = 0; i < nPlatform; ++i) {
+		if (sod_cl.GetDeviceIDs(aPlatform[i], CL_DEVICE_TYPE_GPU, 1, &device, 0) == CL_SUCCESS) break;
+	}
+	if (i >= nPlatform) return SOD_UNSUPPORTED;
+	sod_cl.ctx = sod_cl.CreateContext(0, 1, &device, 0, 0, &err);
+	if (err != CL_SUCCESS) return SOD_UNSUPPORTED;
+	sod_cl.queue = sod_cl.CreateCommandQueue(sod_cl.ctx, device, 0, &err);
+	if (err != CL_SUCCESS) return SOD_UNSUPPORTED;
+	sod_cl.program = sod_cl.CreateProgramWithSource(sod_cl.ctx, 1, &zSrc, 0, &err);
+	if (err != CL_SUCCESS) return SOD_UNSUPPORTED;
+	if (sod_cl.BuildProgram(sod_cl.program, 1, &device, "-cl-mad-enable", 0, 0) != CL_SUCCESS) return SOD_UNSUPPORTED;
+	sod_cl.conv = sod_cl.CreateKernel(sod_cl.program, "conv_forward", &err);
+	if (err != CL_SUCCESS) return SOD_UNSUPPORTED;
+	sod_cl.maxpool = sod_cl.CreateKernel(sod_cl.program, "maxpool_forward", &err);
+	if (err != CL_SUCCESS) return SOD_UNSUPPORTED;
+	return SOD_OK;
+}
+/*
+ * Open the OpenCL device on first use. The library stays loaded even if no
+ * device can be used, the driver may have registered exit handlers.
+ */
+static int sod_cl_open(void)
+{
+	int rc;
+	pthread_mutex_lock(&sod_cl_mutex);
+	if (sod_cl.state == 0) {
+		sod_cl.state = sod_cl_init() == SOD_OK ? 1 : -1;
+	}
+	rc = sod_cl.state > 0 ? SOD_OK : SOD_UNSUPPORTED;
+	pthread_mutex_unlock(&sod_cl_mutex);
+	return rc;
+}
+/* Drop the device copy of a layer's weights, before the host copy is freed */
+static void sod_cl_release_weights(const float *weights)
+{
+	sod_cl_weights **ppEntry, *pEntry = 0;
+	if (!weights) return;
+	pthread_mutex_lock(&sod_cl_mutex);
+	for (ppEntry = &sod_cl.pWeights; *ppEntry; ppEntry = &(*ppEntry)->pNext) {
+		if ((*ppEntry)->weights == weights) {
+			pEntry = *ppEntry;
+			*ppEntry = pEntry->pNext;
+			break;
+		}
+	}
+	if (pEntry) {
+		if (pEntry->w) sod_cl.ReleaseMemObject(pEntry->w);
+		if (pEntry->mul) sod_cl.ReleaseMemObject(pEntry->mul);
+		if (pEntry->add) sod_cl.ReleaseMemObject(pEntry->add);
+		free(pEntry);
+	}
+	pthread_mutex_unlock(&sod_cl_mutex);
+}
+/* Device copy of a layer's weights, uploaded on first use. Called with sod_cl_mutex held */
+static sod_cl_weights *sod_cl_layer_weights(const layer *l)
+{
+	sod_cl_weights *pEntry;
+	float *aMul, *aAdd;
+	cl_int err = CL_SUCCESS, err2 = CL_SUCCESS, err3 = CL_SUCCESS;
+	int i;
+	for (pEntry = sod_cl.pWeights; pEntry; pEntry = pEntry->pNext) {
+		if (pEntry->weights == l->weights) return pEntry;
+	}
+	pEntry = calloc(1, sizeof(sod_cl_weights));
+	aMul = malloc(2 * l->n * sizeof(float));
+	if (!pEntry || !aMul) {
+		free(pEntry);
+		free(aMul);
+		return 0;
+	}
+	aAdd = &aMul[l->n];
+	/* Same arithmetic as forward_batchnorm_layer() followed by the bias */
+	for (i = 0; i < l->n; ++i) {
+		if (l->batch_normalize) {
+			aMul[i] = l->scales[i] / (sqrt(l->rolling_variance[i]) + .000001f);
+			aAdd[i] = l->biases[i] - l->rolling_mean[i] * aMul[i];
+		}
+		else {
+			aMul[i] = 1;
+			aAdd[i] = l->biases[i];
+		}
+	}
+	pEntry->weights = l->weights;
+	pEntry->w = sod_cl.CreateBuffer(sod_cl.ctx, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+		(size_t)l->n * l->c * l->size * l->size * sizeof(float), l->weights, &err);
+	pEntry->mul = sod_cl.CreateBuffer(sod_cl.ctx, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+		l->n * sizeof(float), aMul, &err2);
+	pEntry->add = sod_cl.CreateBuffer(sod_cl.ctx, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+		l->n * sizeof(float), aAdd, &err3);
+	free(aMul);
+	if (err != CL_SUCCESS || err2 != CL_SUCCESS || err3 != CL_SUCCESS) {
+		if (pEntry->w) sod_cl.ReleaseMemObject(pEntry->w);
+		if (pEntry->mul) sod_cl.ReleaseMemObject(pEntry->mul);
+		if (pEntry->add) sod_cl.ReleaseMemObject(pEntry->add);
+		free(pEntry);
+		return 0;
+	}
+	pEntry->pNext = sod_cl.pWeights;
+	sod_cl.pWeights = pEntry;
+	return pEntry;
+}
+/*
+ * Run a kernel over an input and an output wrapping host memory, waiting
+ * for the output. Called with sod_cl_mutex held, kernel arguments 2 and up
+ * already set.
+ */
+static int sod_cl_run(cl_kernel kernel, const float *input, size_t nIn, float *output, size_t nOut,
+	cl_uint nDim, const size_t *aGlobal)
+{
+	cl_mem in, out;
+	cl_int err, err2;
+	void *pMap;
+	in = sod_cl.CreateBuffer(sod_cl.ctx, CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR,
+		nIn * sizeof(float), (void *)input, &err);
+	if (err != CL_SUCCESS) return SOD_ABORT;
+	out = sod_cl.CreateBuffer(sod_cl.ctx, CL_MEM_WRITE_ONLY | CL_MEM_USE_HOST_PTR,
+		nOut * sizeof(float), output, &err);
+	if (err != CL_SUCCESS) {
+		sod_cl.ReleaseMemObject(in);
+		return SOD_ABORT;
+	}
+	err = sod_cl.SetKernelArg(kernel, 0, sizeof(cl_mem), &in);
+	err |= sod_cl.SetKernelArg(kernel, 1, sizeof(cl_mem), &out);
+	if (err == CL_SUCCESS) {
+		err = sod_cl.EnqueueNDRangeKernel(sod_cl.queue, kernel, nDim, 0, aGlobal, 0, 0, 0, 0);
+	}
+	if (err == CL_SUCCESS) {
+		/* Mapping synchronizes the host memory with what the kernel wrote */
+		pMap = sod_cl.EnqueueMapBuffer(sod_cl.queue, out, CL_TRUE, CL_MAP_READ, 0,
+			nOut * sizeof(float), 0, 0, 0, &err);
+		if (err == CL_SUCCESS) {
+			err = sod_cl.EnqueueUnmapMemObject(sod_cl.queue, out, pMap, 0, 0, 0);
+		}
+	}
+	err2 = sod_cl.Finish(sod_cl.queue);
+	sod_cl.ReleaseMemObject(in);
+	sod_cl.ReleaseMemObject(out);
+	return err == CL_SUCCESS && err2 == CL_SUCCESS ? SOD_OK : SOD_ABORT;
+}
+static size_t sod_cl_round_up(size_t n)
+{
+	return (n + SOD_CL_GROUP - 1) / SOD_CL_GROUP * SOD_CL_GROUP;
+}
+/* Forward pass of a convolutional layer on the device, SOD_OK if it ran there */
+static int sod_cl_forward_convolutional(const layer *l, const network_state *state)
+{
+	sod_cl_weights *pWeights;
+	size_t aGlobal[3];
+	int out_h = convolutional_out_height((*l));
+	int out_w = convolutional_out_width((*l));
+	cl_kernel k;
+	cl_int err;
+	int act;
+	int rc;
+	if (l->xnor || l->binary || l->weights_q8 || !l->weights) return SOD_UNSUPPORTED;
+	switch (l->activation) {
+	case LINEAR: act = 0; break;
+	case LEAKY: act = 1; break;
+	case RELU: act = 2; break;
+	case LOGISTIC: act = 3; break;
+	default: return SOD_UNSUPPORTED;
+	}
+	if ((double)l->n * l->c * l->size * l->size * out_h * out_w * l->batch < SOD_CL_MIN_WORK) {
+		return SOD_UNSUPPORTED;
+	}
+	pthread_mutex_lock(&sod_cl_mutex);
+	if (sod_cl.state <= 0) {
+		pthread_mutex_unlock(&sod_cl_mutex);
+		return SOD_UNSUPPORTED;
+	}
+	k = sod_cl.conv;
+	pWeights = sod_cl_layer_weights(l);
+	if (!pWeights) {
+		sod_cl.state = -1;
+		pthread_mutex_unlock(&sod_cl_mutex);
+		return SOD_ABORT;
+	}
+	/* Arguments 0 and 1, the input and the output, are set by sod_cl_run() */
+	err = sod_cl.SetKernelArg(k, 2, sizeof(cl_mem), &pWeights->w);
+	err |= sod_cl.SetKernelArg(k, 3, sizeof(cl_mem), &pWeights->mul);
+	err |= sod_cl.SetKernelArg(k, 4, sizeof(cl_mem), &pWeights->add);
+	err |= sod_cl.SetKernelArg(k, 5, sizeof(cl_int), &l->c);
+	err |= sod_cl.SetKernelArg(k, 6, sizeof(cl_int), &l->h);
+	err |= sod_cl.SetKernelArg(k, 7, sizeof(cl_int), &l->w);
+	err |= sod_cl.SetKernelArg(k, 8, sizeof(cl_int), &l->size);
+	err |= sod_cl.SetKernelArg(k, 9, sizeof(cl_int), &l->stride);
+	err |= sod_cl.SetKernelArg(k, 10, sizeof(cl_int), &l->pad);
+	err |= sod_cl.SetKernelArg(k, 11, sizeof(cl_int), &out_h);
+	err |= sod_cl.SetKernelArg(k, 12, sizeof(cl_int), &out_w);
+	err |= sod_cl.SetKernelArg(k, 13, sizeof(cl_int), &act);
+	aGlobal[0] = sod_cl_round_up((size_t)out_h * out_w);
+	aGlobal[1] = (size_t)l->n;
+	aGlobal[2] = (size_t)l->batch;
+	rc = err == CL_SUCCESS ? sod_cl_run(k, state->input, (size_t)l->c * l->h * l->w * l->batch,
+		l->output, (size_t)l->outputs * l->batch, 3, aGlobal) : SOD_ABORT;
+	if (rc != SOD_OK) {
+		sod_cl.state = -1;
+	}
+	pthread_mutex_unlock(&sod_cl_mutex);
+	return rc;
+}
+/* Forward pass of a maxpool layer on the device, SOD_OK if it ran there */
+static int sod_cl_forward_maxpool(const layer *l, const network_state *state)
+{
+	size_t aGlobal[2];
+	cl_kernel k;
+	cl_int err;
+	int rc;
+	if ((double)l->outputs * l->batch * l->size * l->size < SOD_CL_MIN_WORK / 16) {
+		return SOD_UNSUPPORTED;
+	}
+	pthread_mutex_lock(&sod_cl_mutex);
+	if (sod_cl.state <= 0) {
+		pthread_mutex_unlock(&sod_cl_mutex);
+		return SOD_UNSUPPORTED;
+	}
+	k = sod_cl.maxpool;
+	err = sod_cl.SetKernelArg(k, 2, sizeof(cl_int), &l->h);
+	err |= sod_cl.SetKernelArg(k, 3, sizeof(cl_int), &l->w);
+	err |= sod_cl.SetKernelArg(k, 4, sizeof(cl_int), &l->size);
+	err |= sod_cl.SetKernelArg(k, 5, sizeof(cl_int), &l->stride);
+	err |= sod_cl.SetKernelArg(k, 6, sizeof(cl_int), &l->pad);
+	err |= sod_cl.SetKernelArg(k, 7, sizeof(cl_int), &l->out_h);
+	err |= sod_cl.SetKernelArg(k, 8, sizeof(cl_int), &l->out_w);
+	aGlobal[0] = sod_cl_round_up((size_t)l->out_h * l->out_w);
+	aGlobal[1] = (size_t)l->c * l->batch;
+	rc = err == CL_SUCCESS ? sod_cl_run(k, state->input, (size_t)l->c * l->h * l->w * l->batch,
+		l->output, (size_t)l->outputs * l->batch, 2, aGlobal) : SOD_ABORT;
+	if (rc != SOD_OK) {
+		sod_cl.state = -1;
+	}
+	pthread_mutex_unlock(&sod_cl_mutex);
+	return rc;
+}
+#endif /* SOD_OPENCL */
 static void forward_convolutional_layer(convolutional_layer l, network_state state)
 {
 	int out_h = convolutional_out_height(l);
 	int out_w = convolutional_out_width(l);
-	int i, bx, j;
+	int i, bx, g;
 	int m, k, n;
 	float *a, *b, *c;
 
+#ifdef SOD_OPENCL
+	if (state.net->opencl && !state.train && sod_cl_forward_convolutional(&l, &state) == SOD_OK) {
+		return;
+	}
+#endif /* SOD_OPENCL */
 	fill_cpu(l.outputs*l.batch, 0, l.output, 1);
 
 	if (l.xnor) {
@@ -4906,13 +6584,37 @@ static void forward_convolutional_layer(convolutional_layer l, network_state sta
 	c = l.output;
 
 	i = 0;
+	g = conv_batch_group(l);
 
 	for (;;) {
 		if (i >= l.batch)break;
 
-		im2col_cpu(state.input, l.c, l.h, l.w,
-			l.size, l.stride, l.pad, b);
-		gemm(0, 0, m, n, k, 1, a, k, b, n, 1, c, n);
+		if (g > 1) {
+			int nb = l.batch - i < g ? l.batch - i : g;
+			forward_convolution_batched(l, state.input, c, b, nb);
+			c += nb * n * m;
+			state.input += nb * l.c*l.h*l.w;
+			i += nb;
+			continue;
+		}
+		if (l.weights_q8) {
+			forward_convolution_q8(l, state.input, c, b);
+		}
+		else if (l.conv_path == SOD_CONV_1X1) {
+			/* The input already is the k x n matrix im2col would build */
+			gemm(0, 0, m, n, k, 1, a, k, state.input, n, 1, c, n);
+		}
+		else if (l.conv_path == SOD_CONV_DIRECT) {
+			forward_convolution_direct(l, state.input, c);
+		}
+		else if (l.conv_path == SOD_CONV_WINOGRAD) {
+			forward_convolution_winograd(l, state.input, c, b);
+		}
+		else {
+			im2col_cpu(state.input, l.c, l.h, l.w,
+				l.size, l.stride, l.pad, b);
+			gemm(0, 0, m, n, k, 1, a, k, b, n, 1, c, n);
+		}
 		c += n * m;
 		state.input += l.c*l.h*l.w;
 
@@ -4923,24 +6625,10 @@ static void forward_convolutional_layer(convolutional_layer l, network_state sta
 		forward_batchnorm_layer(l, state);
 	}
 
-	bx = 0;
-
-	for (;;) {
-		if (bx >= l.batch) break;
+	for (bx = 0; bx < l.batch; ++bx) {
 		for (i = 0; i < l.n; ++i) {
-			for (j = 0; j < n; ++j) {
-				l.output[(bx*n + i)*n + j] += l.biases[i];
-			}
+			conv_bias_activate(l.output + (bx*l.n + i)*n, n, l.biases[i], l.activation);
 		}
-		bx++;
-	}
-	i = 0;
-	/* 	activate_array(l.output, m*n*l.batch, l.activation); */
-
-	for (;;) {
-		if (i >= m * n*l.batch)break;
-		l.output[i] = activate(l.output[i], l.activation);
-		i++;
 	}
 	if (l.binary || l.xnor) swap_binary(&l);
 }
@@ -5073,7 +6761,15 @@ static void update_convolutional_layer(convolutional_layer l, int batch, float l
 	scal_cpu(size, momentum, l.weight_updates, 1);
 }
 static size_t get_workspace_size(layer l) {
-	return (size_t)l.out_h*l.out_w*l.size*l.size*l.c * sizeof(float);
+	switch (l.conv_path) {
+	case SOD_CONV_1X1:
+	case SOD_CONV_DIRECT:
+		return 0;
+	case SOD_CONV_WINOGRAD:
+		return conv_winograd_workspace(l);
+	default:
+		return conv_im2col_workspace(l);
+	}
 }
 static convolutional_layer make_convolutional_layer(int batch, int h, int w, int c, int n, int size, int stride, int padding, ACTIVATION activation, int batch_normalize, int binary, int xnor, int adam)
 {
@@ -5206,6 +6902,7 @@ static convolutional_layer make_convolutional_layer(int batch, int h, int w, int
 #endif
 	}
 #endif
+	l.conv_path = conv_select_path(l);
 	l.workspace_size = get_workspace_size(l);
 	l.activation = activation;
 	return l;
@@ -7047,74 +8744,359 @@ static float box_rmse(box a, box b)
 		pow(a.w - b.w, 2) +
 		pow(a.h - b.h, 2));
 }
-/* ============================== NMS ================================= */
-typedef struct {
-	int index;
-	int class;
-	float **probs;
-} sortable_bbox;
-static int nms_comparator(const void *pa, const void *pb)
+/* ============================== NMS ================================= */
+/*
+ * Per class, the candidates above the detection threshold are sorted by
+ * score and only the SOD_NMS_TOPK best take part, so crowded scenes with low
+ * thresholds do not turn NMS quadratic in thousands of boxes. Candidates
+ * below the threshold can never suppress a box that is reported, so they
+ * are left out. Each survivor then suppresses the lower ones overlapping it
+ * by more than the NMS threshold; corners and areas are laid out as arrays
+ * so one box is tested against 8 (AVX) or 4 (SSE, NEON) others at a time.
+ */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SOD_NMS_X86
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define SOD_NMS_NEON
+#endif
+/* Candidates per class that take part in NMS, lower ones are dropped */
+#define SOD_NMS_TOPK 256
+typedef struct {
+	float score;
+	int index;
+} sod_nms_cand;
+/* Scratch buffers, one entry per box, allocated with the network */
+typedef struct {
+	sod_nms_cand *aCand;   /* Candidates, best first */
+	float *x1, *y1, *x2, *y2, *area; /* Their boxes, structure of arrays */
+	unsigned char *aDead;  /* Suppressed candidates */
+} sod_nms_buf;
+/* Marks candidates after i overlapping candidate i by more than thresh */
+typedef void(*ProcNmsRow)(sod_nms_buf *p, int i, int n, float thresh);
+static sod_nms_buf *nms_buf_alloc(int total)
+{
+	sod_nms_buf *p = calloc(1, sizeof(sod_nms_buf));
+	if (!p) return 0;
+	p->aCand = malloc(total * sizeof(sod_nms_cand));
+	p->x1 = malloc(5 * total * sizeof(float));
+	p->aDead = malloc(total);
+	if (!p->aCand || !p->x1 || !p->aDead) {
+		free(p->aCand);
+		free(p->x1);
+		free(p->aDead);
+		free(p);
+		return 0;
+	}
+	p->y1 = p->x1 + total;
+	p->x2 = p->y1 + total;
+	p->y2 = p->x2 + total;
+	p->area = p->y2 + total;
+	return p;
+}
+static void nms_buf_free(sod_nms_buf *p)
+{
+	if (p) {
+		free(p->aCand);
+		free(p->x1);
+		free(p->aDead);
+		free(p);
+	}
+}
+static int nms_cand_cmp(const void *pa, const void *pb)
+{
+	float a = ((const sod_nms_cand *)pa)->score;
+	float b = ((const sod_nms_cand *)pb)->score;
+	if (a < b) return 1;
+	if (a > b) return -1;
+	return 0;
+}
+/* Scalar test of candidate i against candidates [from, n) */
+static void nms_row_range(sod_nms_buf *p, int i, int from, int n, float thresh)
+{
+	float ax1 = p->x1[i], ay1 = p->y1[i], ax2 = p->x2[i], ay2 = p->y2[i], aarea = p->area[i];
+	int j;
+	for (j = from; j < n; ++j) {
+		float w = (ax2 < p->x2[j] ? ax2 : p->x2[j]) - (ax1 > p->x1[j] ? ax1 : p->x1[j]);
+		float h = (ay2 < p->y2[j] ? ay2 : p->y2[j]) - (ay1 > p->y1[j] ? ay1 : p->y1[j]);
+		if (w < 0 || h < 0) continue;
+		float inter = w * h;
+		/* IoU > thresh, without the division */
+		if (inter > thresh * (aarea + p->area[j] - inter)) p->aDead[j] = 1;
+	}
+}
+static void nms_row_ref(sod_nms_buf *p, int i, int n, float thresh)
+{
+	nms_row_range(p, i, i + 1, n, thresh);
+}
+#ifdef SOD_NMS_X86
+__attribute__((target("sse2")))
+static void nms_row_sse(sod_nms_buf *p, int i, int n, float thresh)
+{
+	__m128 ax1 = _mm_set1_ps(p->x1[i]), ay1 = _mm_set1_ps(p->y1[i]);
+	__m128 ax2 = _mm_set1_ps(p->x2[i]), ay2 = _mm_set1_ps(p->y2[i]);
+	__m128 aarea = _mm_set1_ps(p->area[i]), t = _mm_set1_ps(thresh), zero = _mm_setzero_ps();
+	int j = i + 1;
+	for (; j + 4 <= n; j += 4) {
+		__m128 w = _mm_sub_ps(_mm_min_ps(ax2, _mm_loadu_ps(p->x2 + j)), _mm_max_ps(ax1, _mm_loadu_ps(p->x1 + j)));
+		__m128 h = _mm_sub_ps(_mm_min_ps(ay2, _mm_loadu_ps(p->y2 + j)), _mm_max_ps(ay1, _mm_loadu_ps(p->y1 + j)));
+		__m128 inter = _mm_mul_ps(w, h);
+		__m128 uni = _mm_sub_ps(_mm_add_ps(aarea, _mm_loadu_ps(p->area + j)), inter);
+		__m128 m = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(w, zero), _mm_cmpge_ps(h, zero)),
+			_mm_cmpgt_ps(inter, _mm_mul_ps(t, uni)));
+		int bits = _mm_movemask_ps(m);
+		while (bits) {
+			p->aDead[j + __builtin_ctz(bits)] = 1;
+			bits &= bits - 1;
+		}
+	}
+	nms_row_range(p, i, j, n, thresh);
+}
+__attribute__((target("avx")))
+static void nms_row_avx(sod_nms_buf *p, int i, int n, float thresh)
+{
+	__m256 ax1 = _mm256_set1_ps(p->x1[i]), ay1 = _mm256_set1_ps(p->y1[i]);
+	__m256 ax2 = _mm256_set1_ps(p->x2[i]), ay2 = _mm256_set1_ps(p->y2[i]);
+	__m256 aarea = _mm256_set1_ps(p->area[i]), t = _mm256_set1_ps(thresh), zero = _mm256_setzero_ps();
+	int j = i + 1;
+	for (; j + 8 <= n; j += 8) {
+		__m256 w = _mm256_sub_ps(_mm256_min_ps(ax2, _mm256_loadu_ps(p->x2 + j)), _mm256_max_ps(ax1, _mm256_loadu_ps(p->x1 + j)));
+		__m256 h = _mm256_sub_ps(_mm256_min_ps(ay2, _mm256_loadu_ps(p->y2 + j)), _mm256_max_ps(ay1, _mm256_loadu_ps(p->y1 + j)));
+		__m256 inter = _mm256_mul_ps(w, h);
+		__m256 uni = _mm256_sub_ps(_mm256_add_ps(aarea, _mm256_loadu_ps(p->area + j)), inter);
+		__m256 m = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(w, zero, _CMP_GE_OQ), _mm256_cmp_ps(h, zero, _CMP_GE_OQ)),
+			_mm256_cmp_ps(inter, _mm256_mul_ps(t, uni), _CMP_GT_OQ));
+		int bits = _mm256_movemask_ps(m);
+		while (bits) {
+			p->aDead[j + __builtin_ctz(bits)] = 1;
+			bits &= bits - 1;
+		}
+	}
+	nms_row_range(p, i, j, n, thresh);
+}
+#endif /* SOD_NMS_X86 */
+#ifdef SOD_NMS_NEON
+static void nms_row_neon(sod_nms_buf *p, int i, int n, float thresh)
+{
+	float32x4_t ax1 = vdupq_n_f32(p->x1[i]), ay1 = vdupq_n_f32(p->y1[i]);
+	float32x4_t ax2 = vdupq_n_f32(p->x2[i]), ay2 = vdupq_n_f32(p->y2[i]);
+	float32x4_t aarea = vdupq_n_f32(p->area[i]), t = vdupq_n_f32(thresh), zero = vdupq_n_f32(0);
+	int j = i + 1;
+	for (; j + 4 <= n; j += 4) {
+		float32x4_t w = vsubq_f32(vminq_f32(ax2, vld1q_f32(p->x2 + j)), vmaxq_f32(ax1, vld1q_f32(p->x1 + j)));
+		float32x4_t h = vsubq_f32(vminq_f32(ay2, vld1q_f32(p->y2 + j)), vmaxq_f32(ay1, vld1q_f32(p->y1 + j)));
+		float32x4_t inter = vmulq_f32(w, h);
+		float32x4_t uni = vsubq_f32(vaddq_f32(aarea, vld1q_f32(p->area + j)), inter);
+		uint32x4_t m = vandq_u32(vandq_u32(vcgeq_f32(w, zero), vcgeq_f32(h, zero)),
+			vcgtq_f32(inter, vmulq_f32(t, uni)));
+		uint32_t lanes[4];
+		int k;
+		vst1q_u32(lanes, m);
+		for (k = 0; k < 4; ++k) {
+			if (lanes[k]) p->aDead[j + k] = 1;
+		}
+	}
+	nms_row_range(p, i, j, n, thresh);
+}
+#endif /* SOD_NMS_NEON */
+/* Row kernels compiled in, best first */
+static const char *azNmsVariant[] = {
+#if defined(SOD_NMS_X86)
+	"avx",
+	"sse",
+#elif defined(SOD_NMS_NEON)
+	"neon",
+#endif
+	"reference"
+};
+/* Row kernel in use, picked on the first NMS */
+static ProcNmsRow xNmsRow = 0;
+/*
+ * Look up a row kernel by name, NULL when it is not compiled in or the CPU
+ * lacks the instructions it needs.
+ */
+static ProcNmsRow nms_find_kernel(const char *zName)
+{
+#if defined(SOD_NMS_X86)
+	__builtin_cpu_init();
+	if (strcmp(zName, "avx") == 0) {
+		return __builtin_cpu_supports("avx") ? nms_row_avx : 0;
+	}
+	if (strcmp(zName, "sse") == 0) {
+		return __builtin_cpu_supports("sse2") ? nms_row_sse : 0;
+	}
+#elif defined(SOD_NMS_NEON)
+	if (strcmp(zName, "neon") == 0) {
+		return nms_row_neon;
+	}
+#endif
+	if (strcmp(zName, "reference") == 0) {
+		return nms_row_ref;
+	}
+	return 0;
+}
+static ProcNmsRow nms_select_kernel(void)
 {
-	sortable_bbox a = *(sortable_bbox *)pa;
-	sortable_bbox b = *(sortable_bbox *)pb;
-	float diff = a.probs[a.index][b.class] - b.probs[b.index][b.class];
-	if (diff < 0) return 1;
-	else if (diff > 0) return -1;
-	return 0;
+	/* Idempotent, so concurrent first calls only race to the same answer */
+	if (xNmsRow) {
+		return xNmsRow;
+	}
+	ProcNmsRow xRow = 0;
+	size_t i;
+	for (i = 0; i < sizeof(azNmsVariant) / sizeof(azNmsVariant[0]) && !xRow; ++i) {
+		xRow = nms_find_kernel(azNmsVariant[i]);
+	}
+	xNmsRow = xRow;
+	return xRow;
 }
-static void do_nms_obj(box *boxes, float **probs, int total, int classes, float thresh)
+/*
+ * NMS on probs[][k] for each class k in [kFirst, kLast]. With bAll, a
+ * suppressed box loses the scores of all classes (objectness NMS).
+ */
+static void do_nms_fast(sod_nms_buf *p, box *boxes, float **probs, int total, int classes,
+	int kFirst, int kLast, int bAll, float score_thresh, float thresh)
 {
-	int i, j, k;
-	sortable_bbox *s = calloc(total, sizeof(sortable_bbox));
-	for (i = 0; i < total; ++i) {
-		s[i].index = i;
-		s[i].class = classes;
-		s[i].probs = probs;
-	}
-
-	qsort(s, total, sizeof(sortable_bbox), nms_comparator);
-	for (i = 0; i < total; ++i) {
-		if (probs[s[i].index][classes] == 0) continue;
-		box a = boxes[s[i].index];
-		for (j = i + 1; j < total; ++j) {
-			box b = boxes[s[j].index];
-			if (box_iou(a, b) > thresh) {
-				for (k = 0; k < classes + 1; ++k) {
-					probs[s[j].index][k] = 0;
+	ProcNmsRow xRow = nms_select_kernel();
+	int i, j, k, c;
+	for (k = kFirst; k <= kLast; ++k) {
+		int n = 0;
+		for (i = 0; i < total; ++i) {
+			if (probs[i][k] > score_thresh) {
+				p->aCand[n].score = probs[i][k];
+				p->aCand[n].index = i;
+				n++;
+			}
+		}
+		if (n < 2) continue;
+		qsort(p->aCand, n, sizeof(sod_nms_cand), nms_cand_cmp);
+		if (n > SOD_NMS_TOPK) {
+			for (i = SOD_NMS_TOPK; i < n; ++i) {
+				float *pr = probs[p->aCand[i].index];
+				if (bAll) {
+					for (c = 0; c < classes + 1; ++c) pr[c] = 0;
+				}
+				else {
+					pr[k] = 0;
 				}
 			}
+			n = SOD_NMS_TOPK;
+		}
+		for (i = 0; i < n; ++i) {
+			box b = boxes[p->aCand[i].index];
+			p->x1[i] = b.x - b.w / 2;
+			p->y1[i] = b.y - b.h / 2;
+			p->x2[i] = b.x + b.w / 2;
+			p->y2[i] = b.y + b.h / 2;
+			p->area[i] = b.w * b.h;
+			p->aDead[i] = 0;
+		}
+		for (i = 0; i < n - 1; ++i) {
+			if (!p->aDead[i]) xRow(p, i, n, thresh);
+		}
+		for (j = 1; j < n; ++j) {
+			if (!p->aDead[j]) continue;
+			float *pr = probs[p->aCand[j].index];
+			if (bAll) {
+				for (c = 0; c < classes + 1; ++c) pr[c] = 0;
+			}
+			else {
+				pr[k] = 0;
+			}
 		}
 	}
-	free(s);
 }
-static void do_nms_sort(box *boxes, float **probs, int total, int classes, float thresh)
+/* =============================================================== Kernels =============================================================== */
+/*
+ * Entry points to the compute kernels, so benchmarks and tests can time
+ * and compare every compiled variant.
+ */
+SOD_APIEXPORT int sod_kernel_variants(const char *zKernel, const char **azVariant, int nMax)
 {
-	int i, j, k;
-	sortable_bbox *s = calloc(total, sizeof(sortable_bbox));
-
-	for (i = 0; i < total; ++i) {
-		s[i].index = i;
-		s[i].class = 0;
-		s[i].probs = probs;
+	int n = 0;
+	size_t i;
+	if (zKernel == 0 || azVariant == 0) {
+		return 0;
 	}
-
-	for (k = 0; k < classes; ++k) {
-		for (i = 0; i < total; ++i) {
-			s[i].class = k;
+	if (strcmp(zKernel, "gemm") == 0) {
+		return gemm_list_variants(azVariant, nMax);
+	}
+	if (strcmp(zKernel, "nms") == 0) {
+		for (i = 0; i < sizeof(azNmsVariant) / sizeof(azNmsVariant[0]) && n < nMax; ++i) {
+			if (nms_find_kernel(azNmsVariant[i])) azVariant[n++] = azNmsVariant[i];
 		}
-		qsort(s, total, sizeof(sortable_bbox), nms_comparator);
-		for (i = 0; i < total; ++i) {
-			if (probs[s[i].index][k] == 0) continue;
-			box a = boxes[s[i].index];
-			for (j = i + 1; j < total; ++j) {
-				box b = boxes[s[j].index];
-				if (box_iou(a, b) > thresh) {
-					probs[s[j].index][k] = 0;
-				}
-			}
+	}
+	return n;
+}
+SOD_APIEXPORT int sod_kernel_use(const char *zKernel, const char *zVariant)
+{
+	ProcNmsRow xRow;
+	if (zKernel == 0) {
+		return SOD_UNSUPPORTED;
+	}
+	if (strcmp(zKernel, "gemm") == 0) {
+		return gemm_use_variant(zVariant);
+	}
+	if (strcmp(zKernel, "nms") == 0) {
+		if (zVariant == 0) {
+			xNmsRow = 0;
+			nms_select_kernel();
+			return SOD_OK;
+		}
+		xRow = nms_find_kernel(zVariant);
+		if (xRow == 0) {
+			return SOD_UNSUPPORTED;
 		}
+		xNmsRow = xRow;
+		return SOD_OK;
 	}
-	free(s);
+	return SOD_UNSUPPORTED;
+}
+SOD_APIEXPORT void sod_kernel_gemm(int TA, int TB, int M, int N, int K, float ALPHA,
+	float *A, int lda,
+	float *B, int ldb,
+	float BETA,
+	float *C, int ldc)
+{
+	gemm(TA, TB, M, N, K, ALPHA, A, lda, B, ldb, BETA, C, ldc);
+}
+SOD_APIEXPORT void sod_kernel_im2col(float *data_im, int channels, int height, int width,
+	int ksize, int stride, int pad, float *data_col)
+{
+	im2col_cpu(data_im, channels, height, width, ksize, stride, pad, data_col);
+}
+SOD_APIEXPORT int sod_kernel_nms(const sod_box *aBox, float *aScore, int nBox, float thresh)
+{
+	sod_nms_buf *p;
+	box *aBoxes;
+	float **apProb;
+	int i, nKept = 0;
+	if (nBox < 1) {
+		return 0;
+	}
+	p = nms_buf_alloc(nBox);
+	aBoxes = malloc(nBox * sizeof(box));
+	apProb = malloc(nBox * sizeof(float *));
+	if (p == 0 || aBoxes == 0 || apProb == 0) {
+		nms_buf_free(p);
+		free(aBoxes);
+		free(apProb);
+		return SOD_OUTOFMEM;
+	}
+	for (i = 0; i < nBox; ++i) {
+		/* Centre and size, as the detection layers produce them */
+		aBoxes[i].w = (float)aBox[i].w;
+		aBoxes[i].h = (float)aBox[i].h;
+		aBoxes[i].x = (float)aBox[i].x + aBoxes[i].w / 2;
+		aBoxes[i].y = (float)aBox[i].y + aBoxes[i].h / 2;
+		apProb[i] = &aScore[i];
+	}
+	do_nms_fast(p, aBoxes, apProb, nBox, 1, 0, 0, 0, 0, thresh);
+	for (i = 0; i < nBox; ++i) {
+		if (aScore[i] > 0) nKept++;
+	}
+	nms_buf_free(p);
+	free(aBoxes);
+	free(apProb);
+	return nKept;
 }
 /* =============================================================== Region =============================================================== */
 static float get_hierarchy_probability(float *x, tree *hier, int c)
@@ -8118,6 +10100,12 @@ static void forward_maxpool_layer(const maxpool_layer l, network_state state)
 	int w = l.out_w;
 	int c = l.c;
 
+#ifdef SOD_OPENCL
+	/* The indexes are only needed to train */
+	if (state.net->opencl && !state.train && sod_cl_forward_maxpool(&l, &state) == SOD_OK) {
+		return;
+	}
+#endif /* SOD_OPENCL */
 	for (b = 0; b < l.batch; ++b) {
 		for (k = 0; k < c; ++k) {
 			for (i = 0; i < h; ++i) {
@@ -8841,6 +10829,81 @@ static void prepare_rnn_seed(sod_cnn *pNet, int len) {
 		pNet->aInput[pNet->c_rnn] = 0;
 	}
 }
+/*
+ * Point the weighted layers of dst at the weights of src, a network made from
+ * the same architecture, and free the weights dst allocated. dst only keeps
+ * its activations and workspace, so any number of networks can run from one
+ * copy of the weights. src must outlive dst and is never written to.
+ */
+static int share_network_weights(network *dst, const network *src)
+{
+	int i;
+	if (dst->n != src->n) {
+		return SOD_UNSUPPORTED;
+	}
+	/* Check the whole network before changing anything */
+	for (i = 0; i < dst->n; ++i) {
+		const layer *d = &dst->layers[i], *s = &src->layers[i];
+		if (d->type != s->type) {
+			return SOD_UNSUPPORTED;
+		}
+		switch (d->type) {
+		case CONVOLUTIONAL:
+			if (d->n != s->n || d->c != s->c || d->size != s->size || d->binary || d->xnor) {
+				return SOD_UNSUPPORTED;
+			}
+			break;
+		case CONNECTED:
+			if (d->inputs != s->inputs || d->outputs != s->outputs) {
+				return SOD_UNSUPPORTED;
+			}
+			break;
+		case DECONVOLUTIONAL:
+		case LOCAL:
+		case RNN:
+		case GRU:
+		case CRNN:
+		case LSTM:
+		case BATCHNORM:
+			/* Weights of their own or of sub layers, not shared */
+			return SOD_UNSUPPORTED;
+		default:
+			break;
+		}
+	}
+	if (src->workspace_size > dst->workspace_size) {
+		float *pWork = calloc(1, src->workspace_size);
+		if (!pWork) {
+			return SOD_OUTOFMEM;
+		}
+		free(dst->workspace);
+		dst->workspace = pWork;
+		dst->workspace_size = src->workspace_size;
+	}
+	for (i = 0; i < dst->n; ++i) {
+		layer *d = &dst->layers[i];
+		const layer *s = &src->layers[i];
+		if (d->type != CONVOLUTIONAL && d->type != CONNECTED) continue;
+		free(d->weights);
+		free(d->biases);
+		free(d->scales);
+		free(d->rolling_mean);
+		free(d->rolling_variance);
+		free(d->weights_q8);
+		free(d->scales_q8);
+		d->weights = s->weights;
+		d->biases = s->biases;
+		d->scales = s->scales;
+		d->rolling_mean = s->rolling_mean;
+		d->rolling_variance = s->rolling_variance;
+		d->weights_q8 = s->weights_q8;
+		d->scales_q8 = s->scales_q8;
+		d->input_scale_q8 = s->input_scale_q8;
+		d->batch_normalize = s->batch_normalize;
+		d->shared_weights = 1;
+	}
+	return SOD_OK;
+}
 /*
  * CAPIREF: Refer to the official documentation at https://sod.pixlab.io/api.html for the expected parameters this interface takes.
  */
@@ -8921,13 +10984,18 @@ int sod_cnn_create(sod_cnn **ppOut, const char *zArch, const char *zModelPath, c
 			goto fail;
 		}
 	}
+	/* Inference only from here on, so the batch normalization can be folded */
+	fuse_batchnorm_network(&pNet->net);
 	/* Fill with default configuration */
 	SySetInit(&pNet->aBoxes, sizeof(sod_box));
 	SySetAlloc(&pNet->aBoxes, 8);
 	SyBlobInit(&pNet->sRnnConsumer);
 	SyBlobInit(&pNet->sLogConsumer);
 	pNet->det = pNet->net.layers[pNet->net.n - 1];
+	pNet->nBatch = 1;
 	if ((pNet->flags & SOD_LAYER_RNN) == 0) {
+		/* The layers stay allocated for the batch of the configuration, see sod_cnn_predict_batch() */
+		pNet->nBatch = pNet->net.batch > 1 ? pNet->net.batch : 1;
 		set_batch_network(&pNet->net, 1);
 	}
 	pNet->nInput = get_network_input_size(&pNet->net);
@@ -8945,6 +11013,7 @@ int sod_cnn_create(sod_cnn **ppOut, const char *zArch, const char *zModelPath, c
 		}
 		pNet->probs = calloc(pNet->det.w*pNet->det.h*pNet->det.n, sizeof(float *));
 		for (j = 0; j < pNet->det.w*pNet->det.h*pNet->det.n; ++j) pNet->probs[j] = calloc(pNet->det.classes + 1, sizeof(float));
+		pNet->aSort = nms_buf_alloc(pNet->det.w*pNet->det.h*pNet->det.n);
 	}
 	if (pNet->flags & SOD_LAYER_RNN) {
 		int i;
@@ -8969,6 +11038,35 @@ fail:
 #endif /* SOD_MEM_DEBUG */
 	return rc;
 }
+/*
+ * Create a network from zArch that runs on the weights of pWeights, loaded
+ * by sod_cnn_create() from the same architecture (int8 weights included).
+ * The new network only allocates its activations and workspace. pWeights
+ * must not be destroyed before the networks sharing its weights, and must
+ * not be reconfigured with SOD_CNN_INT8_MODEL once it has any.
+ */
+int sod_cnn_create_shared(sod_cnn **ppOut, const char *zArch, sod_cnn *pWeights, const char **pzErr)
+{
+	sod_cnn *pNet;
+	int rc;
+	*ppOut = 0;
+	if (pWeights == 0 || pWeights->state != SOD_NET_STATE_READY) {
+		if (pzErr) *pzErr = "No network to share the weights of";
+		return SOD_UNSUPPORTED;
+	}
+	rc = sod_cnn_create(&pNet, zArch, 0, pzErr);
+	if (rc != SOD_OK) {
+		return rc;
+	}
+	rc = share_network_weights(&pNet->net, &pWeights->net);
+	if (rc != SOD_OK) {
+		if (pzErr) *pzErr = rc == SOD_OUTOFMEM ? "Out of memory" : "The network weights cannot be shared";
+		sod_cnn_destroy(pNet);
+		return rc;
+	}
+	*ppOut = pNet;
+	return SOD_OK;
+}
 /*
  * CAPIREF: Refer to the official documentation at https://sod.pixlab.io/api.html for the expected parameters this interface takes.
  */
@@ -9037,6 +11135,58 @@ int sod_cnn_config(sod_cnn * pNet, SOD_CNN_CONFIG conf, ...)
 		}
 	}
 					   break;
+	case SOD_CNN_INT8_CALIBRATE: {
+		/* Record layer input ranges on each prediction, for sod_cnn_save_int8() */
+		int bEnable = va_arg(ap, int);
+		pNet->net.calibrate_q8 = bEnable;
+	}
+							  break;
+	case SOD_CNN_BATCH_CAPACITY: {
+		/* Most images sod_cnn_predict_batch() takes in one call */
+		int *pCapacity = va_arg(ap, int *);
+		if (pCapacity) {
+			*pCapacity = pNet->nBatch;
+		}
+	}
+							  break;
+	case SOD_CNN_INT8_MODEL: {
+		/* Switch the layers of an int8 model to the int8 path */
+		const char *zPath = va_arg(ap, const char *);
+		rc = load_q8_weights(&pNet->net, zPath);
+	}
+							  break;
+	case SOD_CNN_GEMM_THREADS: {
+		/* Process wide: threads a large matrix product is split over */
+		int nThreads = va_arg(ap, int);
+#ifdef SOD_BLOCKED_GEMM
+		if (nThreads < 1) {
+			nThreads = 1;
+		}
+		if (nThreads > SOD_GEMM_MAX_THREADS) {
+			nThreads = SOD_GEMM_MAX_THREADS;
+		}
+		sod_gemm_threads = nThreads;
+#else
+		(void)nThreads;
+		rc = SOD_UNSUPPORTED;
+#endif /* SOD_BLOCKED_GEMM */
+	}
+							  break;
+	case SOD_CNN_OPENCL: {
+		/* Run the layers OpenCL handles on the GPU, the rest on the CPU */
+		int bEnable = va_arg(ap, int);
+#ifdef SOD_OPENCL
+		if (bEnable && sod_cl_open() != SOD_OK) {
+			bEnable = 0;
+			rc = SOD_UNSUPPORTED;
+		}
+		pNet->net.opencl = bEnable;
+#else
+		(void)bEnable;
+		rc = SOD_UNSUPPORTED;
+#endif /* SOD_OPENCL */
+	}
+							  break;
 	case SOD_CNN_TEMPERATURE: {
 		double temp = va_arg(ap, double);
 		int i;
@@ -9067,6 +11217,9 @@ void sod_cnn_destroy(sod_cnn *pNet)
 		if (pNet->boxes) {
 			free(pNet->boxes);
 		}
+		if (pNet->aSort) {
+			nms_buf_free((sod_nms_buf *)pNet->aSort);
+		}
 		if (pNet->aInput) {
 			free(pNet->aInput);
 		}
@@ -9104,12 +11257,18 @@ float * sod_cnn_prepare_image(sod_cnn *pNet, sod_img in)
 	}
 	pNet->ow = in.w;
 	pNet->oh = in.h;
+	if (in.h == pNet->net.h && in.w == pNet->net.w) {
+		/* Already the network size, feed it as is */
+		return in.data;
+	}
+	/* Resize into the buffers of the network, grown on the first frame of a given size only */
 	pCur = &pNet->sRz;
-	if (in.h != pNet->net.h || in.w != pNet->net.w) {
-		sod_md_alloc_dyn_img(pCur, pNet->net.w, pNet->net.h, pNet->net.c);
-		sod_md_alloc_dyn_img(&pNet->sPart, pNet->net.w, in.h, pNet->net.c);
-		sodFastImageResize(in, pNet->sRz, pNet->sPart, pNet->net.w, pNet->net.h);
+	sod_md_alloc_dyn_img(pCur, pNet->net.w, pNet->net.h, pNet->net.c);
+	sod_md_alloc_dyn_img(&pNet->sPart, pNet->net.w, in.h, pNet->net.c);
+	if (pCur->data == 0 || pNet->sPart.data == 0) {
+		return 0;
 	}
+	sodFastImageResize(in, pNet->sRz, pNet->sPart, pNet->net.w, pNet->net.h);
 	return pCur->data;
 }
 /*
@@ -9125,6 +11284,88 @@ int sod_cnn_get_network_size(sod_cnn * pNet, int * pWidth, int * pHeight, int *
 	if (pChannels) *pChannels = pNet->net.c;
 	return SOD_OK;
 }
+/*
+ * Quantize the network to int8 using the input ranges recorded while
+ * SOD_CNN_INT8_CALIBRATE was on, and write the result for SOD_CNN_INT8_MODEL.
+ */
+int sod_cnn_save_int8(sod_cnn * pNet, const char * zPath)
+{
+	if (pNet->state != SOD_NET_STATE_READY) {
+		return SOD_UNSUPPORTED;
+	}
+	return save_q8_weights(&pNet->net, zPath);
+}
+/*
+ * Turn the detection layer output of one image into boxes scaled to ow x oh,
+ * in pNet->aBoxes.
+ */
+static void cnn_collect_boxes(sod_cnn *pNet, layer det, int ow, int oh)
+{
+	sod_box sBox;
+	int i;
+	SySetReset(&pNet->aBoxes);
+	if (det.classes > 0) {
+		if (det.type == REGION) {
+			get_region_boxes(det, 1, 1, pNet->thresh, pNet->probs, pNet->boxes, 0, 0, pNet->hier_thresh);
+			if (det.softmax_tree && pNet->nms) {
+				do_nms_fast((sod_nms_buf *)pNet->aSort, pNet->boxes, pNet->probs, det.w*det.h*det.n, det.classes,
+					det.classes, det.classes, 1, pNet->thresh, pNet->nms);
+			}
+			else if (pNet->nms) {
+				do_nms_fast((sod_nms_buf *)pNet->aSort, pNet->boxes, pNet->probs, det.w*det.h*det.n, det.classes,
+					0, det.classes - 1, 0, pNet->thresh, pNet->nms);
+			}
+		}
+		else if (det.type == DETECTION) {
+			get_detection_boxes(det, 1, 1, pNet->thresh, pNet->probs, pNet->boxes, 0);
+			if (pNet->nms) {
+				do_nms_fast((sod_nms_buf *)pNet->aSort, pNet->boxes, pNet->probs, det.side*det.side*det.n, det.classes,
+					0, det.classes - 1, 0, pNet->thresh, pNet->nms);
+			}
+		}
+		for (i = 0; i < det.w*det.h*det.n; ++i) {
+			float max = pNet->probs[i][0];
+			int class = 0, v;
+			float prob;
+			for (v = 1; v < det.classes; ++v) {
+				if (pNet->probs[i][v] > max) {
+					max = pNet->probs[i][v];
+					class = v;
+				}
+			}
+			prob = pNet->probs[i][class];
+			if (prob > pNet->thresh) {
+				box b = pNet->boxes[i];
+				int left = (b.x - b.w / 2.)*ow;
+				int top = (b.y - b.h / 2.)*oh;
+				int right = (b.x + b.w / 2.)*ow;
+				int bot = (b.y + b.h / 2.)*oh;
+				if (left < 0) left = 0;
+				if (top < 0) top = 0;
+				if (right > ow - 1) right = ow - 1;
+				if (bot > oh - 1) bot = oh - 1;
+				sBox.score = prob;
+				sBox.x = left;
+				sBox.y = top;
+				sBox.w = right - left;
+				sBox.h = bot - top;
+				if (pNet->azNames) {
+					/* WARNING: azNames[] must hold at least n 'class' entries. This is fine with the
+					* built-in magic words such as :tiny, :full, etc. Otherwise, expect a SEGFAULT.
+					*/
+					sBox.zName = pNet->azNames[class];
+				}
+				else {
+					sBox.zName = "object";
+				}
+				sBox.pUserData = 0;
+				/* Insert in the set */
+				SySetPut(&pNet->aBoxes, &sBox);
+
+			}
+		}
+	}
+}
 /*
  * CAPIREF: Refer to the official documentation at https://sod.pixlab.io/api.html for the expected parameters this interface takes.
  */
@@ -9152,66 +11393,7 @@ int sod_cnn_predict(sod_cnn * pNet, float * pInput, sod_box **paBox, int *pnBox)
 		}
 	}
 	if (pnBox) {
-		sod_box sBox;
-		SySetReset(&pNet->aBoxes);
-		if (pNet->det.classes > 0) {
-			if (pNet->det.type == REGION) {
-				get_region_boxes(pNet->det, 1, 1, pNet->thresh, pNet->probs, pNet->boxes, 0, 0, pNet->hier_thresh);
-				if (pNet->det.softmax_tree && pNet->nms) {
-					do_nms_obj(pNet->boxes, pNet->probs, pNet->det.w*pNet->det.h*pNet->det.n, pNet->det.classes, pNet->nms);
-				}
-				else if (pNet->nms) {
-					do_nms_sort(pNet->boxes, pNet->probs, pNet->det.w*pNet->det.h*pNet->det.n, pNet->det.classes, pNet->nms);
-				}
-			}
-			else if (pNet->det.type == DETECTION) {
-				get_detection_boxes(pNet->det, 1, 1, pNet->thresh, pNet->probs, pNet->boxes, 0);
-				if (pNet->nms) {
-					do_nms_sort(pNet->boxes, pNet->probs, pNet->det.side*pNet->det.side*pNet->det.n, pNet->det.classes, pNet->nms);
-				}
-			}
-			for (i = 0; i < pNet->det.w*pNet->det.h*pNet->det.n; ++i) {
-				float max = pNet->probs[i][0];
-				int class = 0, v;
-				float prob;
-				for (v = 1; v < pNet->det.classes; ++v) {
-					if (pNet->probs[i][v] > max) {
-						max = pNet->probs[i][v];
-						class = v;
-					}
-				}
-				prob = pNet->probs[i][class];
-				if (prob > pNet->thresh) {
-					box b = pNet->boxes[i];
-					int left = (b.x - b.w / 2.)*pNet->ow;
-					int top = (b.y - b.h / 2.)*pNet->oh;
-					int right = (b.x + b.w / 2.)*pNet->ow;
-					int bot = (b.y + b.h / 2.)*pNet->oh;
-					if (left < 0) left = 0;
-					if (top < 0) top = 0;
-					if (right > pNet->ow - 1) right = pNet->ow - 1;
-					if (bot > pNet->oh - 1) bot = pNet->oh - 1;
-					sBox.score = prob;
-					sBox.x = left;
-					sBox.y = top;
-					sBox.w = right - left;
-					sBox.h = bot - top;
-					if (pNet->azNames) {
-						/* WARNING: azNames[] must hold at least n 'class' entries. This is fine with the
-						* built-in magic words such as :tiny, :full, etc. Otherwise, expect a SEGFAULT.
-						*/
-						sBox.zName = pNet->azNames[class];
-					}
-					else {
-						sBox.zName = "object";
-					}
-					sBox.pUserData = 0;
-					/* Insert in the set */
-					SySetPut(&pNet->aBoxes, &sBox);
-
-				}
-			}
-		}
+		cnn_collect_boxes(pNet, pNet->det, pNet->ow, pNet->oh);
 		if (paBox) {
 			*paBox = (sod_box *)SySetBasePtr(&pNet->aBoxes);
 		}
@@ -9226,6 +11408,74 @@ int sod_cnn_predict(sod_cnn * pNet, float * pInput, sod_box **paBox, int *pnBox)
 	}
 	return SOD_OK;
 }
+/*
+ * Run nImg prepared images through the network at once. pInput holds their
+ * network inputs back to back. The weights of the deep layers are loaded
+ * once for the group instead of once per image (see conv_batch_group()),
+ * and nThreads, when positive, overrides SOD_CNN_GEMM_THREADS for the call.
+ * Read the boxes of each image with sod_cnn_batch_boxes() afterwards.
+ */
+int sod_cnn_predict_batch(sod_cnn * pNet, float * pInput, int nImg, int nThreads)
+{
+	size_t need;
+	int i;
+	if (pNet->state != SOD_NET_STATE_READY || (pNet->flags & SOD_LAYER_RNN) || nImg < 1 || nImg > pNet->nBatch) {
+		return SOD_UNSUPPORTED;
+	}
+	set_batch_network(&pNet->net, nImg);
+	/* Grouped convolutions need more room than one image, grow the workspace on first use */
+	need = pNet->net.workspace_size;
+	for (i = 0; i < pNet->net.n; ++i) {
+		if (pNet->net.layers[i].type == CONVOLUTIONAL && conv_batch_workspace(pNet->net.layers[i]) > need) {
+			need = conv_batch_workspace(pNet->net.layers[i]);
+		}
+	}
+	if (need > pNet->net.workspace_size) {
+		float *pWork = calloc(1, need);
+		if (!pWork) {
+			set_batch_network(&pNet->net, 1);
+			pNet->zErr = "Out of memory for the batch workspace";
+			return SOD_OUTOFMEM;
+		}
+		free(pNet->net.workspace);
+		pNet->net.workspace = pWork;
+		pNet->net.workspace_size = need;
+	}
+#if defined(SOD_BLOCKED_GEMM) && defined(SOD_GEMM_PTHREADS)
+	sod_gemm_batch_threads = nThreads > SOD_GEMM_MAX_THREADS ? SOD_GEMM_MAX_THREADS : nThreads;
+#else
+	(void)nThreads;
+#endif
+	pNet->pOut = network_predict(&pNet->net, pInput);
+#if defined(SOD_BLOCKED_GEMM) && defined(SOD_GEMM_PTHREADS)
+	sod_gemm_batch_threads = 0;
+#endif
+	set_batch_network(&pNet->net, 1);
+	pNet->nBatchRun = nImg;
+	return SOD_OK;
+}
+/*
+ * Boxes of image iImg of the last sod_cnn_predict_batch(), scaled to the
+ * nWidth x nHeight of the original image. The boxes are valid until the
+ * next call on the network.
+ */
+int sod_cnn_batch_boxes(sod_cnn * pNet, int iImg, int nWidth, int nHeight, sod_box **paBox, int *pnBox)
+{
+	layer det;
+	if (pNet->state != SOD_NET_STATE_READY || iImg < 0 || iImg >= pNet->nBatchRun) {
+		return SOD_UNSUPPORTED;
+	}
+	det = pNet->det;
+	det.output += (size_t)iImg * det.outputs;
+	cnn_collect_boxes(pNet, det, nWidth, nHeight);
+	if (paBox) {
+		*paBox = (sod_box *)SySetBasePtr(&pNet->aBoxes);
+	}
+	if (pnBox) {
+		*pnBox = (int)SySetUsed(&pNet->aBoxes);
+	}
+	return SOD_OK;
+}
 #endif /* SOD_DISABLE_CNN */
 /*
 * Image Processing Interfaces.
@@ -13452,10 +15702,27 @@ void sod_realnet_train_release(sod_realnet_trainer * pTrainer)
 #endif /* #ifdSOD_MEM_DEBUG */
 }
 #endif /* SOD_ENABLE_NET_TRAIN */
+/*
+ * The scan of a RealNet model is split into bands of rows, each band run on
+ * its own thread (SOD_REALNET_MODEL_THREADS, 1 by default). Bands are cut from
+ * the rows of every scale laid out in the order a serial scan visits them, so
+ * putting the boxes of the bands back together gives the serial result.
+ */
+#if defined(__unix__) || defined(__APPLE__)
+#include <pthread.h>
+#define SOD_REALNET_PTHREADS
+#endif
+#define SOD_REALNET_MAX_THREADS 16
+/* Scans of fewer windows than this per thread run on one thread */
+#define SOD_REALNET_MIN_THREAD_WINDOWS 16384
+/* Windows of a row run through the cascade together */
+#define SOD_REALNET_LANES 64
 struct sod_realnet
 {
 	SySet aModels;     /* Set of loaded models */
 	SySet aBox;        /* Detection box */
+	SySet aRows;       /* Rows scanned by the model being run */
+	SySet aBand[SOD_REALNET_MAX_THREADS]; /* Boxes found by each scan thread */
 };
 typedef enum {
 	SOD_REALNET_DETECTION = 1 /* An object detection network */
@@ -13482,6 +15749,7 @@ struct sod_realnet_model
 	float stridefactor;
 	float threshold;
 	float nms;
+	int nThreads;
 };
 /*
  * Parse a given binary cascade trained for detection tasks.
@@ -13529,40 +15797,223 @@ static void RealnetFillModel(sod_realnet_model *pModel)
 	pModel->stridefactor = 0.1f;
 	pModel->threshold = 5.0f;
 	pModel->nms = 0.4f;
+	pModel->nThreads = 1;
 	pModel->iType = SOD_REALNET_DETECTION;
 }
 /*
- * Run a Realnet cascade for object detection tasks. 
+ * A row of windows of a given size, as visited by sod_realnet_detect().
+ */
+typedef struct sod_realnet_row sod_realnet_row;
+struct sod_realnet_row
+{
+	float r;    /* Row center */
+	float s;    /* Window size */
+	float cost; /* Windows in the row, to balance the bands */
+};
+/*
+ * A band of rows scanned by one thread.
+ */
+typedef struct sod_realnet_scan sod_realnet_scan;
+struct sod_realnet_scan
+{
+	sod_realnet_model *pModel;
+	const sod_realnet_row *aRow;
+	size_t nRow;
+	const unsigned char *zPixels;
+	int w;
+	int h;
+	SySet *pBox; /* Boxes found in the band */
+};
+/*
+ * Run a Realnet cascade for object detection tasks over the windows of one row.
  * Implementation based on the work on Nenad Markus pico project. License MIT.
+ *
+ * Windows are run SOD_REALNET_LANES at a
+ * time. Each tree is evaluated over every window still alive before moving to
+ * the next one, so the nodes of a tree are fetched once for the whole group and
+ * the many windows rejected by the first trees drop out together. Every window
+ * sums its leaves in tree order, exactly like RealnetRunDetectionCascade().
+ */
+static void RealnetScanRow(sod_realnet_model *pModel, float r, float s, const unsigned char *zPixels, int w, int h, SySet *pBox)
+{
+	int aCol[SOD_REALNET_LANES];
+	float aC[SOD_REALNET_LANES];
+	float aThresh[SOD_REALNET_LANES];
+	int aLive[SOD_REALNET_LANES];
+	const int depth = pModel->depth;
+	const int nLeaf = 1 << depth;
+	int ir = (int)r * 256;
+	int is = (int)s;
+	float dc = MAX(s*pModel->stridefactor, 1.0f);
+	float c = s / 2 + 1;
+	if ((ir + 128 * is) / 256 >= h || (ir - 128 * is) / 256 < 0) {
+		return;
+	}
+	while (c <= w - s / 2 - 1) {
+		const char *zTree = (const char *)pModel->pTrees;
+		float tree_thresh = 0.0f;
+		int nLane = 0, nLive, i, k;
+		/* Next windows of the row that fit in the image */
+		for (; nLane < SOD_REALNET_LANES && c <= w - s / 2 - 1; c += dc) {
+			int ic = (int)c * 256;
+			if ((ic + 128 * is) / 256 >= w || (ic - 128 * is) / 256 < 0) {
+				continue;
+			}
+			aC[nLane] = c;
+			aCol[nLane] = ic;
+			aThresh[nLane] = 0.0f;
+			aLive[nLane] = nLane;
+			nLane++;
+		}
+		nLive = nLane;
+		for (i = 0; i < pModel->ntrees && nLive > 0; i++) {
+			const char *zNodes = zTree - 4;
+			const float *aLeafs = (const float *)(zTree + (nLeaf - 1) * sizeof(int));
+			int nKeep = 0;
+			tree_thresh = aLeafs[nLeaf];
+			for (k = 0; k < nLive; k++) {
+				int n = aLive[k];
+				int ic = aCol[n];
+				int idx = 1;
+				int j;
+				for (j = 0; j < depth; ++j) {
+					idx = 2 * idx + (zPixels[((ir + zNodes[4 * idx + 0] * is) / 256) * w + (ic + zNodes[4 * idx + 1] * is) / 256] <= zPixels[((ir + zNodes[4 * idx + 2] * is) / 256) * w + (ic + zNodes[4 * idx + 3] * is) / 256]);
+				}
+				aThresh[n] = aThresh[n] + aLeafs[idx - nLeaf];
+				if (aThresh[n] > tree_thresh) {
+					aLive[nKeep++] = n;
+				}
+			}
+			nLive = nKeep;
+			zTree += pModel->offset;
+		}
+		/* Windows that went through every tree */
+		for (k = 0; k < nLive; k++) {
+			int n = aLive[k];
+			float thresh = aThresh[n] - tree_thresh;
+			if (thresh >= pModel->threshold) {
+				float cx = aC[n];
+				sod_box bbox;
+				bbox.score = thresh;
+				bbox.zName = pModel->zName;
+				bbox.pUserData = 0;
+				bbox.x = MAX((int)(cx - 0.5*s), 0);
+				bbox.y = MAX((int)(r - 0.5*s), 0);
+				bbox.w = MIN((int)(cx + 0.5*s), w) - bbox.x;
+				bbox.h = MIN((int)(r + 0.5*s), h) - bbox.y;
+				SySetPut(pBox, &bbox);
+			}
+		}
+	}
+}
+static void * RealnetScanThread(void *pArg)
+{
+	sod_realnet_scan *pScan = (sod_realnet_scan *)pArg;
+	size_t n;
+	for (n = 0; n < pScan->nRow; ++n) {
+		RealnetScanRow(pScan->pModel, pScan->aRow[n].r, pScan->aRow[n].s, pScan->zPixels, pScan->w, pScan->h, pScan->pBox);
+	}
+	return 0;
+}
+/*
+ * Scan every scale and window position of a model, appending the boxes found
+ * to pNet->aBox. The first band writes to aBox directly, the others to their
+ * own set which is appended once every band is done.
  */
-static int RealnetRunDetectionCascade(sod_realnet_model *pModel, int r, int c, int s, float *threshold, const unsigned char *zPixels, int w, int h)
+static int RealnetScanModel(sod_realnet *pNet, sod_realnet_model *pModel, const unsigned char *zPixels, int w, int h)
 {
-	const char *zTree = (const char*)pModel->pTrees;
-	float tree_thresh;
+	sod_realnet_scan aScan[SOD_REALNET_MAX_THREADS];
+	sod_realnet_row *aRow;
+	size_t nRow, start, end;
+	double total = 0, done = 0;
+	int nThreads = pModel->nThreads;
 	int i;
-	r = r * 256;
-	c = c * 256;
-	if ((r + 128 * s) / 256 >= h || (r - 128 * s) / 256 < 0 || (c + 128 * s) / 256 >= w || (c - 128 * s) / 256 < 0) {
-		return -1;
+	float s;
+	/* Rows of every scale, in the order of a serial scan */
+	SySetReset(&pNet->aRows);
+	s = pModel->minsize;
+	while (s <= pModel->maxsize) {
+		float r, dr;
+		dr = MAX(s*pModel->stridefactor, 1.0f);
+		for (r = s / 2 + 1; r <= h - s / 2 - 1; r += dr) {
+			sod_realnet_row sRow;
+			sRow.r = r;
+			sRow.s = s;
+			sRow.cost = MAX((w - s) / dr, 0.0f) + 1.0f;
+			total += sRow.cost;
+			if (SOD_OK != SySetPut(&pNet->aRows, &sRow)) {
+				return SOD_OUTOFMEM;
+			}
+		}
+		s = s * pModel->scalefactor;
+	}
+	aRow = (sod_realnet_row *)SySetBasePtr(&pNet->aRows);
+	nRow = SySetUsed(&pNet->aRows);
+	if (total < (double)nThreads * SOD_REALNET_MIN_THREAD_WINDOWS) {
+		nThreads = (int)(total / SOD_REALNET_MIN_THREAD_WINDOWS);
+	}
+	if ((size_t)nThreads > nRow) {
+		nThreads = (int)nRow;
+	}
+	if (nThreads < 1) {
+		nThreads = 1;
+	}
+	/* Contiguous bands of about the same number of windows */
+	start = 0;
+	for (i = 0; i < nThreads; ++i) {
+		double target = total * (i + 1) / nThreads;
+		end = start;
+		if (i == nThreads - 1) {
+			end = nRow;
+		}
+		while (end < nRow && done < target) {
+			done += aRow[end].cost;
+			end++;
+		}
+		aScan[i].pModel = pModel;
+		aScan[i].aRow = &aRow[start];
+		aScan[i].nRow = end - start;
+		aScan[i].zPixels = zPixels;
+		aScan[i].w = w;
+		aScan[i].h = h;
+		aScan[i].pBox = i == 0 ? &pNet->aBox : &pNet->aBand[i];
+		SySetReset(&pNet->aBand[i]);
+		start = end;
+	}
+#ifdef SOD_REALNET_PTHREADS
+	if (nThreads > 1) {
+		pthread_t aThread[SOD_REALNET_MAX_THREADS];
+		/* The calling thread scans the first band */
+		for (i = 1; i < nThreads; ++i) {
+			if (pthread_create(&aThread[i], 0, RealnetScanThread, &aScan[i]) != 0) {
+				RealnetScanThread(&aScan[i]);
+				aThread[i] = pthread_self();
+			}
+		}
+		RealnetScanThread(&aScan[0]);
+		for (i = 1; i < nThreads; ++i) {
+			if (!pthread_equal(aThread[i], pthread_self())) {
+				pthread_join(aThread[i], 0);
+			}
+		}
 	}
-	tree_thresh = 0.0f;
-	for (i = 0; i < pModel->ntrees; i++) {
-		const char *zNodes = zTree - 4;
-		float *aLeafs = (float *)(zTree + ((1 << pModel->depth) - 1) * sizeof(int));
-		int idx = 1;
-		int j;
-		tree_thresh = *(float *)(zTree + ((1 << pModel->depth) - 1) * sizeof(int) + (1 << pModel->depth) * sizeof(float));
-		for (j = 0; j < pModel->depth; ++j) {
-			idx = 2 * idx + (zPixels[((r + zNodes[4 * idx + 0] * s) / 256) * w + (c + zNodes[4 * idx + 1] * s) / 256] <= zPixels[((r + zNodes[4 * idx + 2] * s) / 256) * w + (c + zNodes[4 * idx + 3] * s) / 256]);
-		}
-		*threshold = *threshold + aLeafs[idx - (1 << pModel->depth)];
-		if (*threshold <= tree_thresh) {
-			return -1;
+	else
+#endif /* SOD_REALNET_PTHREADS */
+	{
+		for (i = 0; i < nThreads; ++i) {
+			RealnetScanThread(&aScan[i]);
+		}
+	}
+	for (i = 1; i < nThreads; ++i) {
+		sod_box *aBand = (sod_box *)SySetBasePtr(&pNet->aBand[i]);
+		size_t n;
+		for (n = 0; n < SySetUsed(&pNet->aBand[i]); ++n) {
+			if (SOD_OK != SySetPut(&pNet->aBox, &aBand[n])) {
+				return SOD_OUTOFMEM;
+			}
 		}
-		zTree += pModel->offset;
 	}
-	*threshold = *threshold - tree_thresh;
-	return +1;
+	return SOD_OK;
 }
 /*
  * Non-Maximum Suppression (NMS) on sod_boxes.
@@ -13644,6 +16095,7 @@ static void sodNmsDiscardBoxes(SySet *pBox)
 int sod_realnet_create(sod_realnet **ppOut)
 {
 	sod_realnet *pNet = malloc(sizeof(sod_realnet));
+	int n;
 	*ppOut = pNet;
 	if (pNet == 0) {
 		return SOD_OUTOFMEM;
@@ -13653,6 +16105,10 @@ int sod_realnet_create(sod_realnet **ppOut)
 	SySetAlloc(&pNet->aModels, 8);
 	SySetInit(&pNet->aBox, sizeof(sod_box));
 	SySetAlloc(&pNet->aBox, 16);
+	SySetInit(&pNet->aRows, sizeof(sod_realnet_row));
+	for (n = 0; n < SOD_REALNET_MAX_THREADS; ++n) {
+		SySetInit(&pNet->aBand[n], sizeof(sod_box));
+	}
 	return SOD_OK;
 }
 /*
@@ -13724,7 +16180,7 @@ int sod_realnet_model_config(sod_realnet *pNet, sod_realnet_model_handle handle,
 	int rc = SOD_OK;
 	va_list ap;
 	/* Fetch the target model */
-	pModel = SySetFetch(&pNet->aBox, handle);
+	pModel = SySetFetch(&pNet->aModels, handle);
 	va_start(ap, conf);
 	if (pModel) {
 		switch (conf) {
@@ -13770,6 +16226,24 @@ int sod_realnet_model_config(sod_realnet *pNet, sod_realnet_model_handle handle,
 			pModel->zAbout = zAbout;
 		}
 									 break;
+		case SOD_REALNET_MODEL_THREADS: {
+			/* Threads the scan of the model is split over */
+			int nThreads = va_arg(ap, int);
+			if (nThreads < 1) {
+				nThreads = 1;
+			}
+			if (nThreads > SOD_REALNET_MAX_THREADS) {
+				nThreads = SOD_REALNET_MAX_THREADS;
+			}
+#ifndef SOD_REALNET_PTHREADS
+			if (nThreads > 1) {
+				nThreads = 1;
+				rc = SOD_UNSUPPORTED;
+			}
+#endif /* SOD_REALNET_PTHREADS */
+			pModel->nThreads = nThreads;
+		}
+									 break;
 
 		default:
 			rc = SOD_UNSUPPORTED;
@@ -13794,29 +16268,11 @@ int sod_realnet_detect(sod_realnet *pNet, const unsigned char *zGrayImg, int wid
 	for (n = 0; n < SySetUsed(&pNet->aModels); ++n) {
 		sod_realnet_model *pMl = &aModel[n];
 		size_t nCur = SySetUsed(&pNet->aBox);
-		float s;
+		int rc;
 		/* Start detection */
-		s = pMl->minsize;
-		while (s <= pMl->maxsize) {
-			float r, c, dr, dc;
-			dc = dr = MAX(s*pMl->stridefactor, 1.0f);
-			for (r = s / 2 + 1; r <= height - s / 2 - 1; r += dr) {
-				for (c = s / 2 + 1; c <= width - s / 2 - 1; c += dc) {
-					float thresh = 0.0f; /* cc warning */
-					if (1 == RealnetRunDetectionCascade(pMl, r, c, s, &thresh, zGrayImg, width, height) && thresh >= pMl->threshold) {
-						sod_box bbox;
-						bbox.score = thresh;
-						bbox.zName = pMl->zName;
-						bbox.pUserData = 0;
-						bbox.x = MAX((int)(c - 0.5*s), 0);
-						bbox.y = MAX((int)(r - 0.5*s), 0);
-						bbox.w = MIN((int)(c + 0.5*s), width)  - bbox.x;
-						bbox.h = MIN((int)(r + 0.5*s), height) - bbox.y;
-						SySetPut(&pNet->aBox, &bbox);
-					}
-				}
-			}
-			s = s * pMl->scalefactor;
+		rc = RealnetScanModel(pNet, pMl, zGrayImg, width, height);
+		if (rc != SOD_OK) {
+			return rc;
 		}
 		if (pMl->nms) {
 			/* Non-Maximum Suppression */
@@ -13848,6 +16304,10 @@ void sod_realnet_destroy(sod_realnet * pNet)
 			pVfs->xUnmap(pMl->pMmap, pMl->mapSz);
 		}
 	}
+	for (n = 0; n < SOD_REALNET_MAX_THREADS; ++n) {
+		SySetRelease(&pNet->aBand[n]);
+	}
+	SySetRelease(&pNet->aRows);
 	SySetRelease(&pNet->aBox);
 	SySetRelease(&pNet->aModels);
 	free(pNet);
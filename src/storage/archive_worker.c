@@ -0,0 +1,527 @@
+/**
+ * @file archive_worker.c
+ * @brief Background migration of aged recordings to secondary storage
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sqlite3.h>
+
+#include "storage/archive_worker.h"
+#include "storage/recording_layout.h"
+#include "storage/deletion_worker.h"
+#include "storage/storage_volumes.h"
+#include "storage/storage_latency.h"
+#include "core/logger.h"
+#include "core/config.h"
+#include "database/db_core.h"
+#include "database/db_recordings.h"
+#include "video/recording_thumbnails.h"
+#include "video/thread_utils.h"
+
+// Recordings fetched from the database at a time
+#define ARCHIVE_BATCH 16
+
+// Seconds between checks for recordings that have aged
+#define ARCHIVE_CHECK_INTERVAL 300
+
+// Bytes read and written at a time while copying
+#define ARCHIVE_CHUNK (256 * 1024)
+
+// Archived recordings deleted per expiry query
+#define EXPIRE_BATCH 256
+
+typedef struct {
+    uint64_t id;
+    char file_path[256];
+    char stream_name[64];
+    time_t end_time;
+} archive_candidate_t;
+
+static struct {
+    pthread_t thread;
+    bool running;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    time_t watermark;         // Recordings ending before this have been handled
+} worker = {
+    .running = false,
+    .watermark = 0,
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER
+};
+
+int get_archive_prefix(char *prefix, size_t size) {
+    size_t len = strlen(g_config.archive_path);
+    while (len > 1 && g_config.archive_path[len - 1] == '/') {
+        len--;
+    }
+    if (len == 0 || len + 2 > size) {
+        return -1;
+    }
+    memcpy(prefix, g_config.archive_path, len);
+    prefix[len] = '/';
+    prefix[len + 1] = '\0';
+    return 0;
+}
+
+/**
+ * Get the part of a path below a directory
+ *
+ * @return The rest of the path starting with '/', or NULL if outside
+ */
+static const char *path_below(const char *path, const char *dir) {
+    size_t len = strlen(dir);
+    while (len > 1 && dir[len - 1] == '/') {
+        len--;
+    }
+    if (len == 0 || strncmp(path, dir, len) != 0 || path[len] != '/') {
+        return NULL;
+    }
+    return path + len;
+}
+
+/**
+ * Build the archive path of a recording
+ * The layout below storage_path is kept, so archived files of a stream
+ * stay together.
+ */
+static int archive_destination(const archive_candidate_t *c, char *dest, size_t size) {
+    char prefix[MAX_PATH_LENGTH];
+    if (get_archive_prefix(prefix, sizeof(prefix)) != 0) {
+        return -1;
+    }
+
+    const char *rest = path_below(c->file_path, g_config.storage_path);
+    if (!rest && g_config.mp4_storage_path[0] != '\0') {
+        rest = path_below(c->file_path, g_config.mp4_storage_path);
+    }
+    char volume[MAX_PATH_LENGTH];
+    int index = storage_volume_of_path(c->file_path);
+    if (!rest && index > 0 && storage_volume_path(index, volume, sizeof(volume)) == 0) {
+        rest = path_below(c->file_path, volume);
+    }
+
+    int n;
+    if (rest) {
+        n = snprintf(dest, size, "%s%s", prefix, rest + 1);
+    } else {
+        const char *base = strrchr(c->file_path, '/');
+        n = snprintf(dest, size, "%s%s/%s", prefix, c->stream_name, base ? base + 1 : c->file_path);
+    }
+    return (n > 0 && (size_t)n < size) ? 0 : -1;
+}
+
+/**
+ * Create the directories leading to a file
+ */
+static int make_parent_dirs(const char *path) {
+    char dir[MAX_PATH_LENGTH];
+    strncpy(dir, path, sizeof(dir) - 1);
+    dir[sizeof(dir) - 1] = '\0';
+
+    for (char *p = dir + 1; *p; p++) {
+        if (*p != '/') {
+            continue;
+        }
+        *p = '\0';
+        if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+            log_error("Failed to create archive directory %s: %s", dir, strerror(errno));
+            return -1;
+        }
+        *p = '/';
+    }
+    return 0;
+}
+
+/**
+ * Copy a file at no more than archive_rate_kbps and sync the copy
+ *
+ * @return 0 on success, -1 on error or when the worker is stopped
+ */
+static int copy_file_limited(const char *src, const char *dst) {
+    int in = open(src, O_RDONLY | O_CLOEXEC);
+    if (in < 0) {
+        log_error("Failed to open recording %s: %s", src, strerror(errno));
+        return -1;
+    }
+    struct stat st;
+    if (fstat(in, &st) != 0) {
+        close(in);
+        return -1;
+    }
+
+    int out = open(dst, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (out < 0) {
+        log_error("Failed to create archive copy %s: %s", dst, strerror(errno));
+        close(in);
+        return -1;
+    }
+
+    char *buffer = malloc(ARCHIVE_CHUNK);
+    if (!buffer) {
+        close(in);
+        close(out);
+        return -1;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    uint64_t rate = (uint64_t)g_config.archive_rate_kbps * 1024;
+    uint64_t copied = 0;
+    int result = 0;
+
+    while (worker.running) {
+        ssize_t n = read(in, buffer, ARCHIVE_CHUNK);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            log_error("Failed to read recording %s: %s", src, strerror(errno));
+            result = -1;
+            break;
+        }
+        if (n == 0) {
+            break;
+        }
+
+        for (ssize_t done = 0; done < n; ) {
+            ssize_t w = write(out, buffer + done, n - done);
+            if (w < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                log_error("Failed to write archive copy %s: %s", dst, strerror(errno));
+                result = -1;
+                break;
+            }
+            done += w;
+        }
+        if (result != 0) {
+            break;
+        }
+        copied += n;
+
+        // Sleep off whatever the copy is ahead of the rate limit
+        if (rate > 0) {
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            double elapsed = (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9;
+            double ahead = (double)copied / rate - elapsed;
+            if (ahead > 0) {
+                struct timespec pause = {
+                    .tv_sec = (time_t)ahead,
+                    .tv_nsec = (long)((ahead - (time_t)ahead) * 1e9)
+                };
+                nanosleep(&pause, NULL);
+            }
+        }
+    }
+    free(buffer);
+
+    if (result == 0 && (!worker.running || copied != (uint64_t)st.st_size)) {
+        result = -1;
+    }
+    if (result == 0 && fsync(out) != 0) {
+        log_error("Failed to sync archive copy %s: %s", dst, strerror(errno));
+        result = -1;
+    }
+    if (result == 0) {
+        // Keep the recording's modification time
+        struct timespec times[2] = { st.st_atim, st.st_mtim };
+        futimens(out, times);
+    }
+
+    close(in);
+    if (close(out) != 0) {
+        result = -1;
+    }
+    return result;
+}
+
+/**
+ * Move one recording to the archive
+ *
+ * @return 0 on success or if the recording went away, -1 on error
+ */
+static int archive_recording(const archive_candidate_t *c) {
+    char dest[256];
+    char part[MAX_PATH_LENGTH];
+    if (archive_destination(c, dest, sizeof(dest)) != 0) {
+        log_error("Archive path for recording %s is too long", c->file_path);
+        return -1;
+    }
+    snprintf(part, sizeof(part), "%s.part", dest);
+
+    if (access(c->file_path, F_OK) != 0 && errno == ENOENT) {
+        // Deleted meanwhile; nothing to move
+        return 0;
+    }
+    if (make_parent_dirs(dest) != 0) {
+        return -1;
+    }
+    if (copy_file_limited(c->file_path, part) != 0) {
+        unlink(part);
+        return -1;
+    }
+    if (rename(part, dest) != 0) {
+        log_error("Failed to rename archive copy %s: %s", part, strerror(errno));
+        unlink(part);
+        return -1;
+    }
+
+    int rc = move_recording_file_path(c->id, c->file_path, dest);
+    if (rc != 0) {
+        // Deleted or changed while it was copied, or the update failed
+        unlink(dest);
+        return rc < 0 ? -1 : 0;
+    }
+
+    // Readers that had the old path look it up again, see locate_recording_file()
+    if (unlink(c->file_path) != 0 && errno != ENOENT) {
+        log_warn("Archived recording %s but failed to remove the local copy: %s",
+                 c->file_path, strerror(errno));
+    }
+    // Thumbnails are made again from the archived copy when requested
+    recording_thumbnails_remove(c->file_path);
+    recording_layout_prune(c->file_path);
+    log_debug("Archived recording %s to %s", c->file_path, dest);
+    return 0;
+}
+
+/**
+ * Fetch the next finished local recordings that ended before a time
+ * Continues after (after_time, after_id), by end time.
+ */
+static int select_candidates(time_t before, time_t after_time, uint64_t after_id,
+                             archive_candidate_t *candidates, int max_count) {
+    char prefix[MAX_PATH_LENGTH];
+    if (get_archive_prefix(prefix, sizeof(prefix)) != 0) {
+        return -1;
+    }
+
+    sqlite3 *db = acquire_db_reader();
+    if (!db) {
+        return -1;
+    }
+
+    const char *sql = "SELECT id, file_path, stream_name, end_time FROM recordings "
+                      "WHERE is_complete = 1 AND end_time < ? "
+                      "AND (end_time > ? OR (end_time = ? AND id > ?)) "
+                      "AND substr(file_path, 1, ?) != ? "
+                      "AND file_path NOT LIKE '%.m3u8' "  // HLS recordings stay local
+                      "ORDER BY end_time, id LIMIT ?;";
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+        release_db_reader(db);
+        return -1;
+    }
+
+    sqlite3_bind_int64(stmt, 1, (sqlite3_int64)before);
+    sqlite3_bind_int64(stmt, 2, (sqlite3_int64)after_time);
+    sqlite3_bind_int64(stmt, 3, (sqlite3_int64)after_time);
+    sqlite3_bind_int64(stmt, 4, (sqlite3_int64)after_id);
+    sqlite3_bind_int(stmt, 5, (int)strlen(prefix));
+    sqlite3_bind_text(stmt, 6, prefix, -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 7, max_count);
+
+    int count = 0;
+    while (count < max_count && sqlite3_step(stmt) == SQLITE_ROW) {
+        archive_candidate_t *c = &candidates[count++];
+        const char *path = (const char *)sqlite3_column_text(stmt, 1);
+        const char *stream = (const char *)sqlite3_column_text(stmt, 2);
+        c->id = (uint64_t)sqlite3_column_int64(stmt, 0);
+        strncpy(c->file_path, path ? path : "", sizeof(c->file_path) - 1);
+        c->file_path[sizeof(c->file_path) - 1] = '\0';
+        strncpy(c->stream_name, stream ? stream : "", sizeof(c->stream_name) - 1);
+        c->stream_name[sizeof(c->stream_name) - 1] = '\0';
+        c->end_time = (time_t)sqlite3_column_int64(stmt, 3);
+    }
+    sqlite3_finalize(stmt);
+    release_db_reader(db);
+    return count;
+}
+
+/**
+ * Move every local recording that has aged to the archive
+ * Recordings before the watermark were handled by an earlier pass; a
+ * failure holds the watermark back, so the recording is tried again.
+ */
+static void run_archive_pass(void) {
+    time_t before = time(NULL) - (time_t)g_config.archive_after_hours * 3600;
+    time_t after_time = worker.watermark - 1;
+    uint64_t after_id = 0;
+    time_t first_failure = 0;
+    int archived = 0;
+
+    archive_candidate_t candidates[ARCHIVE_BATCH];
+    while (worker.running) {
+        int count = select_candidates(before, after_time, after_id, candidates, ARCHIVE_BATCH);
+        if (count < 0) {
+            return;
+        }
+
+        for (int i = 0; i < count && worker.running; i++) {
+            if (archive_recording(&candidates[i]) == 0) {
+                archived++;
+            } else if (first_failure == 0) {
+                first_failure = candidates[i].end_time;
+            }
+            after_time = candidates[i].end_time;
+            after_id = candidates[i].id;
+        }
+        if (count < ARCHIVE_BATCH) {
+            break;
+        }
+    }
+
+    if (worker.running) {
+        worker.watermark = first_failure != 0 ? first_failure : before;
+    }
+    if (archived > 0) {
+        log_info("Archived %d recordings to %s", archived, g_config.archive_path);
+    }
+}
+
+static void *archive_worker_thread(void *arg) {
+    (void)arg;
+    thread_set_identity(THREAD_CLASS_SERVICE, "archive", NULL);
+    lower_thread_priority();
+    log_info("Archive worker started for %s", g_config.archive_path);
+
+    pthread_mutex_lock(&worker.mutex);
+    while (worker.running) {
+        pthread_mutex_unlock(&worker.mutex);
+        // Reading recordings off a slow disk waits until it has recovered
+        if (get_db_handle() && storage_latency_worst_level() == STORAGE_LATENCY_OK) {
+            run_archive_pass();
+        }
+        pthread_mutex_lock(&worker.mutex);
+
+        if (worker.running) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += ARCHIVE_CHECK_INTERVAL;
+            pthread_cond_timedwait(&worker.cond, &worker.mutex, &deadline);
+        }
+    }
+    pthread_mutex_unlock(&worker.mutex);
+
+    log_info("Archive worker stopped");
+    return NULL;
+}
+
+int start_archive_worker(void) {
+    if (g_config.archive_path[0] == '\0') {
+        return 0;
+    }
+
+    pthread_mutex_lock(&worker.mutex);
+    if (worker.running) {
+        pthread_mutex_unlock(&worker.mutex);
+        return 0;
+    }
+
+    worker.running = true;
+    if (pthread_create(&worker.thread, NULL, archive_worker_thread, NULL) != 0) {
+        log_error("Failed to create archive worker thread: %s", strerror(errno));
+        worker.running = false;
+        pthread_mutex_unlock(&worker.mutex);
+        return -1;
+    }
+    pthread_mutex_unlock(&worker.mutex);
+    return 0;
+}
+
+void stop_archive_worker(void) {
+    pthread_mutex_lock(&worker.mutex);
+    if (!worker.running) {
+        pthread_mutex_unlock(&worker.mutex);
+        return;
+    }
+    worker.running = false;
+    pthread_cond_signal(&worker.cond);
+    pthread_mutex_unlock(&worker.mutex);
+
+    pthread_join(worker.thread, NULL);
+}
+
+int expire_archived_recordings(uint64_t max_age) {
+    char prefix[MAX_PATH_LENGTH];
+    if (get_archive_prefix(prefix, sizeof(prefix)) != 0) {
+        return 0;
+    }
+
+    // Streams with their own retention_days are expired by the retention engine
+    const char *sql = "SELECT id FROM recordings WHERE end_time < ? AND substr(file_path, 1, ?) = ? "
+                      "AND stream_name NOT IN (SELECT name FROM streams WHERE retention_days > 0) "
+                      "LIMIT ?;";
+    time_t cutoff_time = time(NULL) - max_age;
+    int deleted = 0;
+
+    for (;;) {
+        uint64_t ids[EXPIRE_BATCH];
+        int count = 0;
+
+        sqlite3 *db = acquire_db_reader();
+        if (!db) {
+            return -1;
+        }
+        sqlite3_stmt *stmt;
+        if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+            log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+            release_db_reader(db);
+            return -1;
+        }
+        sqlite3_bind_int64(stmt, 1, (sqlite3_int64)cutoff_time);
+        sqlite3_bind_int(stmt, 2, (int)strlen(prefix));
+        sqlite3_bind_text(stmt, 3, prefix, -1, SQLITE_STATIC);
+        sqlite3_bind_int(stmt, 4, EXPIRE_BATCH);
+        while (count < EXPIRE_BATCH && sqlite3_step(stmt) == SQLITE_ROW) {
+            ids[count++] = (uint64_t)sqlite3_column_int64(stmt, 0);
+        }
+        sqlite3_finalize(stmt);
+        release_db_reader(db);
+
+        int batch_deleted = 0;
+        for (int i = 0; i < count; i++) {
+            if (delete_recording_async(ids[i]) == 0) {
+                batch_deleted++;
+            }
+        }
+        deleted += batch_deleted;
+
+        // Stop on a short batch, or one where nothing could be deleted
+        if (count < EXPIRE_BATCH || batch_deleted == 0) {
+            break;
+        }
+    }
+    return deleted;
+}
+
+int locate_recording_file(recording_metadata_t *recording, struct stat *st) {
+    if (stat(recording->file_path, st) == 0) {
+        return 0;
+    }
+
+    // The archive worker may have moved it since the metadata was read
+    recording_metadata_t current;
+    if (get_recording_metadata_by_id(recording->id, &current) != 0 ||
+        strcmp(current.file_path, recording->file_path) == 0) {
+        return -1;
+    }
+    memcpy(recording->file_path, current.file_path, sizeof(recording->file_path));
+    return stat(recording->file_path, st) == 0 ? 0 : -1;
+}
@@ -0,0 +1,549 @@
+/**
+ * @file compaction_worker.c
+ * @brief Background compaction of short clips and thinning of aged recordings
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sqlite3.h>
+
+#include "storage/compaction_worker.h"
+#include "storage/archive_worker.h"
+#include "storage/deletion_worker.h"
+#include "core/logger.h"
+#include "core/config.h"
+#include "database/db_core.h"
+#include "database/db_compaction.h"
+#include "database/db_recordings.h"
+#include "video/clip_export.h"
+#include "video/load_governor.h"
+#include "storage/storage_latency.h"
+#include "video/recording_thumbnails.h"
+#include "video/thread_utils.h"
+
+// Clips fetched from the database at a time, and the most in one file
+#define COMPACT_BATCH 512
+
+// Seconds between checks for clips that have aged
+#define COMPACT_CHECK_INTERVAL 600
+
+// CPU usage in percent above which the system is not idle
+#define COMPACT_IDLE_CPU 50.0
+
+// Recordings fetched at a time for thinning
+#define THIN_BATCH 32
+
+typedef struct {
+    uint64_t id;
+    int64_t stream_id;
+    char file_path[256];
+    char stream_name[64];
+    time_t start_time;
+    char codec[16];
+    int width;
+    int height;
+} compact_candidate_t;
+
+// Position in candidates ordered by stream, then start time
+typedef struct {
+    int64_t stream_id;
+    time_t start_time;
+    uint64_t id;
+} compact_cursor_t;
+
+static struct {
+    pthread_t thread;
+    bool running;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+} worker = {
+    .running = false,
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER
+};
+
+static bool system_idle(void) {
+    if (load_governor_level() != LOAD_SHED_NONE || storage_latency_worst_level() != STORAGE_LATENCY_OK) {
+        return false;
+    }
+    load_governor_status_t status;
+    load_governor_get_status(&status);
+    return !status.enabled || status.cpu_usage < COMPACT_IDLE_CPU;
+}
+
+// Hour a clip belongs to, in local time like the shard directories
+static long hour_of(time_t t) {
+    struct tm tm;
+    localtime_r(&t, &tm);
+    return ((long)tm.tm_year * 366 + tm.tm_yday) * 24 + tm.tm_hour;
+}
+
+static bool same_run(const compact_candidate_t *a, const compact_candidate_t *b) {
+    return a->stream_id == b->stream_id && hour_of(a->start_time) == hour_of(b->start_time) &&
+           strcmp(a->codec, b->codec) == 0 && a->width == b->width && a->height == b->height;
+}
+
+/**
+ * Fetch the next clips that may be compacted, after a cursor
+ */
+static int select_candidates(time_t before, const compact_cursor_t *after,
+                             compact_candidate_t *candidates, int max_count) {
+    char prefix[MAX_PATH_LENGTH] = "";
+    if (get_archive_prefix(prefix, sizeof(prefix)) != 0) {
+        prefix[0] = '\0';
+    }
+
+    sqlite3 *db = acquire_db_reader();
+    if (!db) {
+        return -1;
+    }
+
+    const char *sql = "SELECT id, stream_id, file_path, stream_name, start_time, codec, width, height "
+                      "FROM recordings WHERE is_complete = 1 AND end_time < ?1 "
+                      "AND end_time > start_time AND end_time - start_time < ?2 "
+                      "AND (stream_id > ?3 OR (stream_id = ?3 AND (start_time > ?4 OR (start_time = ?4 AND id > ?5)))) "
+                      "AND file_path LIKE '%.mp4' "
+                      "AND (?6 = '' OR substr(file_path, 1, length(?6)) != ?6) "
+                      "AND id NOT IN (SELECT recording_id FROM compacted_recordings) "
+                      "AND id NOT IN (SELECT recording_id FROM upload_queue) "
+                      "ORDER BY stream_id, start_time, id LIMIT ?7;";
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+        release_db_reader(db);
+        return -1;
+    }
+
+    sqlite3_bind_int64(stmt, 1, (sqlite3_int64)before);
+    sqlite3_bind_int(stmt, 2, g_config.compact_clip_seconds);
+    sqlite3_bind_int64(stmt, 3, after->stream_id);
+    sqlite3_bind_int64(stmt, 4, (sqlite3_int64)after->start_time);
+    sqlite3_bind_int64(stmt, 5, (sqlite3_int64)after->id);
+    sqlite3_bind_text(stmt, 6, prefix, -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 7, max_count);
+
+    int count = 0;
+    while (count < max_count && sqlite3_step(stmt) == SQLITE_ROW) {
+        compact_candidate_t *c = &candidates[count++];
+        const char *path = (const char *)sqlite3_column_text(stmt, 2);
+        const char *stream = (const char *)sqlite3_column_text(stmt, 3);
+        const char *codec = (const char *)sqlite3_column_text(stmt, 5);
+        c->id = (uint64_t)sqlite3_column_int64(stmt, 0);
+        c->stream_id = sqlite3_column_int64(stmt, 1);
+        snprintf(c->file_path, sizeof(c->file_path), "%s", path ? path : "");
+        snprintf(c->stream_name, sizeof(c->stream_name), "%s", stream ? stream : "");
+        c->start_time = (time_t)sqlite3_column_int64(stmt, 4);
+        snprintf(c->codec, sizeof(c->codec), "%s", codec ? codec : "");
+        c->width = sqlite3_column_int(stmt, 6);
+        c->height = sqlite3_column_int(stmt, 7);
+    }
+    sqlite3_finalize(stmt);
+    release_db_reader(db);
+    return count;
+}
+
+static int sync_file(const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    int rc = fsync(fd);
+    close(fd);
+    return rc;
+}
+
+/**
+ * Copy a run of clips into one file and point their recordings at it
+ *
+ * @return Number of clips compacted, or -1 on error
+ */
+static int compact_run(const compact_candidate_t *run, int count) {
+    char container[256];
+    char part[MAX_PATH_LENGTH];
+    const char *slash = strrchr(run[0].file_path, '/');
+    int dir_len = slash ? (int)(slash - run[0].file_path) : 0;
+    struct tm tm;
+    char stamp[32];
+    localtime_r(&run[0].start_time, &tm);
+    strftime(stamp, sizeof(stamp), "%Y%m%d_%H%M%S", &tm);
+    if (!slash || snprintf(container, sizeof(container), "%.*s/compacted_%s.mp4", dir_len,
+                           run[0].file_path, stamp) >= (int)sizeof(container)) {
+        log_error("Compacted file path for %s is too long", run[0].file_path);
+        return -1;
+    }
+    snprintf(part, sizeof(part), "%s.part", container);
+
+    clip_export_source_t *sources = calloc((size_t)count, sizeof(clip_export_source_t));
+    int64_t *offsets = calloc((size_t)count, sizeof(int64_t));
+    int64_t *durations = calloc((size_t)count, sizeof(int64_t));
+    compacted_recording_t *compacted = calloc((size_t)count, sizeof(compacted_recording_t));
+    int result = -1;
+    if (!sources || !offsets || !durations || !compacted) {
+        goto done;
+    }
+
+    for (int i = 0; i < count; i++) {
+        sources[i].file_path = run[i].file_path;
+        sources[i].start_time = run[i].start_time;
+    }
+
+    struct stat st;
+    if (clip_export_compact(sources, count, part, offsets, durations) != 0 ||
+        sync_file(part) != 0 || rename(part, container) != 0 || stat(container, &st) != 0) {
+        log_warn("Failed to compact %d clips of %s into %s", count, run[0].stream_name, container);
+        unlink(part);
+        goto done;
+    }
+
+    // Each recording's size becomes its share of the file, by duration
+    int kept = 0;
+    int64_t total_ms = 0;
+    for (int i = 0; i < count; i++) {
+        if (offsets[i] >= 0) {
+            total_ms += durations[i];
+        }
+    }
+    uint64_t assigned = 0;
+    for (int i = 0; i < count; i++) {
+        if (offsets[i] < 0) {
+            continue;
+        }
+        compacted_recording_t *c = &compacted[kept++];
+        c->recording_id = run[i].id;
+        snprintf(c->source_path, sizeof(c->source_path), "%s", run[i].file_path);
+        c->offset_ms = offsets[i];
+        c->duration_ms = durations[i];
+        c->size_bytes = total_ms > 0 ? (uint64_t)st.st_size * (uint64_t)durations[i] / (uint64_t)total_ms : 0;
+        assigned += c->size_bytes;
+    }
+    if (kept > 0) {
+        compacted[kept - 1].size_bytes += (uint64_t)st.st_size - assigned;
+    }
+
+    int rc = kept >= 2 ? compact_recordings(container, compacted, kept) : 1;
+    if (rc != 0) {
+        // Nothing refers to the file; the clips stay as they were
+        unlink(container);
+        result = rc < 0 ? -1 : 0;
+        goto done;
+    }
+
+    // The thumbnails stay, named after the clips (see db_compaction.h)
+    for (int i = 0; i < kept; i++) {
+        char index[MAX_PATH_LENGTH];
+        if (unlink(compacted[i].source_path) != 0 && errno != ENOENT) {
+            log_warn("Compacted clip %s but failed to remove it: %s", compacted[i].source_path,
+                     strerror(errno));
+        }
+        if (recording_thumbnails_path(compacted[i].source_path, RECORDING_KEYFRAME_INDEX,
+                                      index, sizeof(index)) == 0) {
+            unlink(index);
+        }
+    }
+    log_info("Compacted %d clips of %s into %s", kept, run[0].stream_name, container);
+    result = kept;
+
+done:
+    free(sources);
+    free(offsets);
+    free(durations);
+    free(compacted);
+    return result;
+}
+
+typedef struct {
+    uint64_t id;
+    char file_path[256];
+    time_t start_time;
+    time_t end_time;
+} thin_candidate_t;
+
+/**
+ * Fetch the next recordings to thin that ended before a time
+ * Continues after (after_time, after_id), by end time.
+ */
+static int select_thin_candidates(time_t before, time_t after_time, uint64_t after_id,
+                                  thin_candidate_t *candidates, int max_count) {
+    sqlite3 *db = acquire_db_reader();
+    if (!db) {
+        return -1;
+    }
+
+    const char *sql = "SELECT id, file_path, start_time, end_time FROM recordings "
+                      "WHERE thinned = 0 AND is_complete = 1 AND end_time < ? "
+                      "AND (end_time > ? OR (end_time = ? AND id > ?)) "
+                      "AND file_path NOT LIKE '%.m3u8' "  // HLS recordings are left as they are
+                      "ORDER BY end_time, id LIMIT ?;";
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+        release_db_reader(db);
+        return -1;
+    }
+
+    sqlite3_bind_int64(stmt, 1, (sqlite3_int64)before);
+    sqlite3_bind_int64(stmt, 2, (sqlite3_int64)after_time);
+    sqlite3_bind_int64(stmt, 3, (sqlite3_int64)after_time);
+    sqlite3_bind_int64(stmt, 4, (sqlite3_int64)after_id);
+    sqlite3_bind_int(stmt, 5, max_count);
+
+    int count = 0;
+    while (count < max_count && sqlite3_step(stmt) == SQLITE_ROW) {
+        thin_candidate_t *c = &candidates[count++];
+        const char *path = (const char *)sqlite3_column_text(stmt, 1);
+        c->id = (uint64_t)sqlite3_column_int64(stmt, 0);
+        snprintf(c->file_path, sizeof(c->file_path), "%s", path ? path : "");
+        c->start_time = (time_t)sqlite3_column_int64(stmt, 2);
+        c->end_time = (time_t)sqlite3_column_int64(stmt, 3);
+    }
+    sqlite3_finalize(stmt);
+    release_db_reader(db);
+    return count;
+}
+
+// Whether a recording was thinned since it was fetched, with another in its file
+static bool already_thinned(uint64_t id) {
+    sqlite3 *db = acquire_db_reader();
+    if (!db) {
+        return true;
+    }
+    bool thinned = true;
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, "SELECT thinned FROM recordings WHERE id = ?;", -1, &stmt, NULL) == SQLITE_OK) {
+        sqlite3_bind_int64(stmt, 1, (sqlite3_int64)id);
+        thinned = sqlite3_step(stmt) != SQLITE_ROW || sqlite3_column_int(stmt, 0) != 0;
+        sqlite3_finalize(stmt);
+    }
+    release_db_reader(db);
+    return thinned;
+}
+
+/**
+ * Rewrite a recording's file with only its key frames, in place
+ * A compacted recording's whole file is rewritten, for all recordings in it.
+ *
+ * @return Bytes saved, or -1 on error
+ */
+static int64_t thin_recording(const thin_candidate_t *c) {
+    char part[MAX_PATH_LENGTH];
+    snprintf(part, sizeof(part), "%s.thin.part", c->file_path);
+
+    struct stat before;
+    if (stat(c->file_path, &before) != 0) {
+        // Deleted meanwhile
+        return 0;
+    }
+
+    // Times in the file stay as they were, so a compacted file's offsets still hold
+    clip_export_source_t source = {
+        .file_path = c->file_path,
+        .start_time = c->start_time
+    };
+    struct stat after;
+    if (clip_export_keyframes(&source, part) != 0 || sync_file(part) != 0 || stat(part, &after) != 0) {
+        log_warn("Failed to thin recording %s", c->file_path);
+        unlink(part);
+        return -1;
+    }
+
+    // A recording of key frames only, such as MJPEG, is not rewritten
+    bool smaller = after.st_size < before.st_size;
+    if (smaller && rename(part, c->file_path) != 0) {
+        log_error("Failed to replace %s with its key frames: %s", c->file_path, strerror(errno));
+        unlink(part);
+        return -1;
+    }
+    if (!smaller) {
+        unlink(part);
+    }
+
+    // The keyframe index no longer matches; the file is not fragmented anymore
+    char index[MAX_PATH_LENGTH];
+    if (smaller && recording_thumbnails_path(c->file_path, RECORDING_KEYFRAME_INDEX, index, sizeof(index)) == 0) {
+        unlink(index);
+    }
+
+    uint64_t size = (uint64_t)(smaller ? after.st_size : before.st_size);
+    if (mark_recording_thinned(c->id, c->file_path, size) < 0) {
+        return -1;
+    }
+    return (int64_t)before.st_size - (int64_t)size;
+}
+
+/**
+ * Thin every recording older than thin_after_days, while the system stays idle
+ */
+static void run_thinning_pass(void) {
+    time_t before = time(NULL) - (time_t)g_config.thin_after_days * 86400;
+    time_t after_time = 0;
+    uint64_t after_id = 0;
+    int thinned = 0;
+    int64_t saved = 0;
+
+    thin_candidate_t candidates[THIN_BATCH];
+    while (worker.running) {
+        int count = select_thin_candidates(before, after_time, after_id, candidates, THIN_BATCH);
+        if (count <= 0) {
+            break;
+        }
+
+        for (int i = 0; i < count && worker.running; i++) {
+            if (!system_idle()) {
+                log_debug("System busy, thinning postponed");
+                count = 0;
+                break;
+            }
+            if (!already_thinned(candidates[i].id)) {
+                int64_t result = thin_recording(&candidates[i]);
+                if (result >= 0) {
+                    thinned++;
+                    saved += result;
+                }
+            }
+            after_time = candidates[i].end_time;
+            after_id = candidates[i].id;
+        }
+        if (count < THIN_BATCH) {
+            break;
+        }
+    }
+
+    if (thinned > 0) {
+        log_info("Thinned %d recordings to their key frames, saving %lld MiB", thinned,
+                 (long long)(saved / (1024 * 1024)));
+    }
+}
+
+/**
+ * Compact every run of clips that has aged, while the system stays idle
+ */
+static void run_compaction_pass(void) {
+    time_t before = time(NULL) - (time_t)g_config.compact_after_hours * 3600;
+    compact_cursor_t cursor = {INT64_MIN, 0, 0};
+    int files = 0;
+    int clips = 0;
+
+    compact_candidate_t *candidates = malloc(COMPACT_BATCH * sizeof(compact_candidate_t));
+    if (!candidates) {
+        return;
+    }
+
+    while (worker.running) {
+        int count = select_candidates(before, &cursor, candidates, COMPACT_BATCH);
+        if (count <= 0) {
+            break;
+        }
+
+        int first = 0;
+        while (first < count && worker.running) {
+            int end = first + 1;
+            while (end < count && same_run(&candidates[first], &candidates[end])) {
+                end++;
+            }
+            // A run reaching the end of a full batch may go on in the next one
+            if (end == count && count == COMPACT_BATCH && first > 0) {
+                break;
+            }
+            if (!system_idle()) {
+                log_debug("System busy, compaction postponed");
+                free(candidates);
+                return;
+            }
+            if (end - first >= 2) {
+                int compacted = compact_run(&candidates[first], end - first);
+                if (compacted > 0) {
+                    files++;
+                    clips += compacted;
+                }
+            }
+            cursor.stream_id = candidates[end - 1].stream_id;
+            cursor.start_time = candidates[end - 1].start_time;
+            cursor.id = candidates[end - 1].id;
+            first = end;
+        }
+        if (count < COMPACT_BATCH) {
+            break;
+        }
+    }
+
+    free(candidates);
+    if (files > 0) {
+        log_info("Compacted %d clips into %d files", clips, files);
+    }
+}
+
+static void *compaction_worker_thread(void *arg) {
+    (void)arg;
+    thread_set_identity(THREAD_CLASS_SERVICE, "compaction", NULL);
+    lower_thread_priority();
+    log_info("Compaction worker started");
+
+    pthread_mutex_lock(&worker.mutex);
+    while (worker.running) {
+        pthread_mutex_unlock(&worker.mutex);
+        if (get_db_handle() && g_config.compact_clip_seconds > 0) {
+            run_compaction_pass();
+        }
+        if (get_db_handle() && g_config.thin_after_days > 0) {
+            run_thinning_pass();
+        }
+        pthread_mutex_lock(&worker.mutex);
+
+        if (worker.running) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += COMPACT_CHECK_INTERVAL;
+            pthread_cond_timedwait(&worker.cond, &worker.mutex, &deadline);
+        }
+    }
+    pthread_mutex_unlock(&worker.mutex);
+
+    log_info("Compaction worker stopped");
+    return NULL;
+}
+
+int start_compaction_worker(void) {
+    if (g_config.compact_clip_seconds <= 0 && g_config.thin_after_days <= 0) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&worker.mutex);
+    if (worker.running) {
+        pthread_mutex_unlock(&worker.mutex);
+        return 0;
+    }
+
+    worker.running = true;
+    if (pthread_create(&worker.thread, NULL, compaction_worker_thread, NULL) != 0) {
+        log_error("Failed to create compaction worker thread: %s", strerror(errno));
+        worker.running = false;
+        pthread_mutex_unlock(&worker.mutex);
+        return -1;
+    }
+    pthread_mutex_unlock(&worker.mutex);
+    return 0;
+}
+
+void stop_compaction_worker(void) {
+    pthread_mutex_lock(&worker.mutex);
+    if (!worker.running) {
+        pthread_mutex_unlock(&worker.mutex);
+        return;
+    }
+    worker.running = false;
+    pthread_cond_signal(&worker.cond);
+    pthread_mutex_unlock(&worker.mutex);
+
+    pthread_join(worker.thread, NULL);
+}
@@ -0,0 +1,237 @@
+/**
+ * @file deletion_worker.c
+ * @brief Background unlinking of deleted recording files
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+
+#include "storage/deletion_worker.h"
+#include "storage/recording_layout.h"
+#include "core/logger.h"
+#include "database/db_recordings.h"
+#include "video/hls_recording.h"
+#include "video/recording_thumbnails.h"
+#include "video/thread_utils.h"
+
+// Files taken from the queue at a time
+#define DELETION_BATCH 256
+
+// Threads unlinking a batch; each unlink mostly waits on the file system
+// for its own inode, so a few in flight finish a large batch much sooner
+#define DELETION_THREADS 4
+
+// Seconds between queue checks when nobody queues anything
+#define DELETION_CHECK_INTERVAL 60
+
+// From linux/ioprio.h, which not every libc ships
+#define IOPRIO_CLASS_IDLE 3
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_WHO_PROCESS 1
+
+static struct {
+    pthread_t thread;
+    bool running;
+    bool work_queued;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+} worker = {
+    .running = false,
+    .work_queued = false,
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER
+};
+
+void lower_thread_priority(void) {
+#ifdef SYS_ioprio_set
+    pid_t tid = (pid_t)syscall(SYS_gettid);
+    if (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, tid, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT) != 0) {
+        log_debug("Could not set idle I/O priority for a storage worker: %s", strerror(errno));
+    }
+    // On Linux the nice value is per thread
+    setpriority(PRIO_PROCESS, tid, 10);
+#endif
+}
+
+// Part of a batch unlinked by one thread
+typedef struct {
+    const pending_file_deletion_t *pending;
+    bool *done;
+    int first;
+    int end;
+    bool helper;                // Runs on its own thread
+} unlink_range_t;
+
+static void *unlink_range(void *arg) {
+    unlink_range_t *range = (unlink_range_t *)arg;
+    if (range->helper) {
+        lower_thread_priority();
+    }
+
+    for (int i = range->first; i < range->end && worker.running; i++) {
+        const char *path = range->pending[i].file_path;
+        if (hls_recording_unlink(path) != 0 && errno != ENOENT) {
+            // Left in the queue and tried again on the next pass
+            log_warn("Failed to delete recording file: %s (error: %s)", path, strerror(errno));
+            continue;
+        }
+        recording_thumbnails_remove(path);
+        recording_layout_prune(path);
+        log_debug("Deleted recording file: %s", path);
+        range->done[i] = true;
+    }
+    return NULL;
+}
+
+/**
+ * Unlink one batch of queued files
+ *
+ * @return Number of files taken from the queue, or -1 on error
+ */
+static int drain_batch(void) {
+    static pending_file_deletion_t pending[DELETION_BATCH];
+    int count = get_pending_file_deletions(pending, DELETION_BATCH);
+    if (count <= 0) {
+        return count;
+    }
+
+    // The batch is split between this thread and helpers
+    bool done[DELETION_BATCH] = {false};
+    unlink_range_t ranges[DELETION_THREADS];
+    pthread_t helpers[DELETION_THREADS];
+    bool started[DELETION_THREADS] = {false};
+    int threads = count < DELETION_THREADS ? 1 : DELETION_THREADS;
+    for (int t = 0; t < threads; t++) {
+        ranges[t] = (unlink_range_t){
+            .pending = pending,
+            .done = done,
+            .first = count * t / threads,
+            .end = count * (t + 1) / threads,
+            .helper = t > 0
+        };
+        if (t > 0) {
+            started[t] = pthread_create(&helpers[t], NULL, unlink_range, &ranges[t]) == 0;
+        }
+    }
+    unlink_range(&ranges[0]);
+    for (int t = 1; t < threads; t++) {
+        if (started[t]) {
+            pthread_join(helpers[t], NULL);
+        } else {
+            ranges[t].helper = false;
+            unlink_range(&ranges[t]);
+        }
+    }
+
+    int64_t done_ids[DELETION_BATCH];
+    int done_count = 0;
+    for (int i = 0; i < count; i++) {
+        if (done[i]) {
+            done_ids[done_count++] = pending[i].id;
+        }
+    }
+
+    if (done_count > 0 && remove_pending_file_deletions(done_ids, done_count) != 0) {
+        return -1;
+    }
+    return done_count;
+}
+
+static void *deletion_worker_thread(void *arg) {
+    (void)arg;
+    thread_set_identity(THREAD_CLASS_SERVICE, "deletion", NULL);
+    lower_thread_priority();
+    log_info("Deletion worker started");
+
+    pthread_mutex_lock(&worker.mutex);
+    while (worker.running) {
+        worker.work_queued = false;
+        pthread_mutex_unlock(&worker.mutex);
+
+        // Files that cannot be deleted stay queued, so stop on a batch
+        // that made no progress instead of retrying it at once
+        int drained;
+        do {
+            drained = drain_batch();
+        } while (drained == DELETION_BATCH && worker.running);
+
+        pthread_mutex_lock(&worker.mutex);
+        if (worker.running && !worker.work_queued) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += DELETION_CHECK_INTERVAL;
+            pthread_cond_timedwait(&worker.cond, &worker.mutex, &deadline);
+        }
+    }
+    pthread_mutex_unlock(&worker.mutex);
+
+    log_info("Deletion worker stopped");
+    return NULL;
+}
+
+int start_deletion_worker(void) {
+    pthread_mutex_lock(&worker.mutex);
+    if (worker.running) {
+        pthread_mutex_unlock(&worker.mutex);
+        return 0;
+    }
+
+    worker.running = true;
+    if (pthread_create(&worker.thread, NULL, deletion_worker_thread, NULL) != 0) {
+        log_error("Failed to create deletion worker thread: %s", strerror(errno));
+        worker.running = false;
+        pthread_mutex_unlock(&worker.mutex);
+        return -1;
+    }
+    pthread_mutex_unlock(&worker.mutex);
+    return 0;
+}
+
+void stop_deletion_worker(void) {
+    pthread_mutex_lock(&worker.mutex);
+    if (!worker.running) {
+        pthread_mutex_unlock(&worker.mutex);
+        return;
+    }
+    worker.running = false;
+    pthread_cond_signal(&worker.cond);
+    pthread_mutex_unlock(&worker.mutex);
+
+    pthread_join(worker.thread, NULL);
+}
+
+static void wake_worker(void) {
+    pthread_mutex_lock(&worker.mutex);
+    worker.work_queued = true;
+    pthread_cond_signal(&worker.cond);
+    pthread_mutex_unlock(&worker.mutex);
+}
+
+int delete_recording_async(uint64_t id) {
+    if (delete_recording_deferred(id) != 0) {
+        return -1;
+    }
+
+    wake_worker();
+    return 0;
+}
+
+int delete_recordings_async(const uint64_t *ids, int count, bool *deleted,
+                            recording_delete_progress_fn progress, void *opaque) {
+    int deleted_count = delete_recordings_deferred(ids, count, deleted, progress, opaque);
+    if (deleted_count > 0) {
+        wake_worker();
+    }
+    return deleted_count;
+}
@@ -0,0 +1,203 @@
+/**
+ * Recording directory layout
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "core/config.h"
+#include "core/logger.h"
+#include "storage/recording_layout.h"
+#include "storage/storage_volumes.h"
+
+int recording_layout_stream_dir(const char *stream_name, char *dir, size_t size) {
+    return storage_volume_stream_dir(stream_name, dir, size) >= 0 ? 0 : -1;
+}
+
+/**
+ * Get the directory of a new recording on the volume chosen for it
+ */
+static int layout_dir(const char *stream_name, time_t time, char *dir, size_t size) {
+    char stream_dir[MAX_PATH_LENGTH];
+    if (recording_layout_stream_dir(stream_name, stream_dir, sizeof(stream_dir)) != 0) {
+        return -1;
+    }
+
+    if (g_config.shard_recordings) {
+        return recording_layout_shard_dir(stream_dir, time, dir, size);
+    }
+    int n = snprintf(dir, size, "%s", stream_dir);
+    return (n > 0 && (size_t)n < size) ? 0 : -1;
+}
+
+int recording_layout_shard_dir(const char *stream_dir, time_t time, char *dir, size_t size) {
+    struct tm tm;
+    localtime_r(&time, &tm);
+
+    char shard[32];
+    strftime(shard, sizeof(shard), "%Y/%m/%d/%H", &tm);
+
+    int n = snprintf(dir, size, "%s/%s", stream_dir, shard);
+    return (n > 0 && (size_t)n < size) ? 0 : -1;
+}
+
+int recording_layout_dir(const char *stream_name, time_t time, char *dir, size_t size) {
+    if (!stream_name) {
+        return -1;
+    }
+
+    if (layout_dir(stream_name, time, dir, size) != 0) {
+        log_error("Recording directory of stream %s is too long", stream_name);
+        return -1;
+    }
+    if (recording_layout_make_dirs(dir) == 0) {
+        return 0;
+    }
+
+    // With several volumes, the recording goes on another one while this one is passed over
+    if (storage_volumes_count() == 1) {
+        return -1;
+    }
+    storage_volume_failed(dir);
+    if (layout_dir(stream_name, time, dir, size) != 0) {
+        return -1;
+    }
+    return recording_layout_make_dirs(dir);
+}
+
+int recording_layout_make_dirs(const char *dir) {
+    char path[MAX_PATH_LENGTH];
+    int n = snprintf(path, sizeof(path), "%s", dir);
+    if (n <= 0 || (size_t)n >= sizeof(path)) {
+        return -1;
+    }
+
+    // Most calls find the directory of the hour already there
+    struct stat st;
+    if (stat(path, &st) == 0 && S_ISDIR(st.st_mode)) {
+        return 0;
+    }
+
+    for (char *p = path + 1; ; p++) {
+        if (*p != '/' && *p != '\0') {
+            continue;
+        }
+        char c = *p;
+        *p = '\0';
+        if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+            log_error("Failed to create recording directory %s: %s", path, strerror(errno));
+            return -1;
+        }
+        *p = c;
+        if (c == '\0') {
+            break;
+        }
+    }
+    return 0;
+}
+
+bool recording_layout_is_shard_name(const char *name) {
+    size_t len = strlen(name);
+    if (len != 2 && len != 4) {
+        return false;
+    }
+    for (size_t i = 0; i < len; i++) {
+        if (!isdigit((unsigned char)name[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Check whether a directory path ends in YYYY/MM/DD/HH
+ */
+static bool is_hour_dir(const char *dir) {
+    static const size_t lengths[RECORDING_SHARD_DEPTH] = {2, 2, 2, 4};
+    const char *end = dir + strlen(dir);
+
+    for (int level = 0; level < RECORDING_SHARD_DEPTH; level++) {
+        const char *start = end;
+        while (start > dir && start[-1] != '/') {
+            start--;
+        }
+        if ((size_t)(end - start) != lengths[level] || start == dir) {
+            return false;
+        }
+        for (const char *p = start; p < end; p++) {
+            if (!isdigit((unsigned char)*p)) {
+                return false;
+            }
+        }
+        end = start - 1;
+    }
+    return true;
+}
+
+bool recording_layout_is_sharded(const char *path) {
+    char dir[MAX_PATH_LENGTH];
+    snprintf(dir, sizeof(dir), "%s", path);
+    char *slash = strrchr(dir, '/');
+    if (!slash) {
+        return false;
+    }
+    *slash = '\0';
+    return is_hour_dir(dir);
+}
+
+void recording_layout_prune(const char *path) {
+    if (!path) {
+        return;
+    }
+
+    char dir[MAX_PATH_LENGTH];
+    snprintf(dir, sizeof(dir), "%s", path);
+    char *slash = strrchr(dir, '/');
+    if (!slash) {
+        return;
+    }
+    *slash = '\0';
+
+    // A segmented recording is a directory of its own inside the hour
+    if (!is_hour_dir(dir)) {
+        slash = strrchr(dir, '/');
+        if (!slash) {
+            return;
+        }
+        *slash = '\0';
+        if (!is_hour_dir(dir)) {
+            return;
+        }
+    }
+
+    char current[MAX_PATH_LENGTH];
+    if (recording_layout_shard_dir("", time(NULL), current, sizeof(current)) == 0) {
+        size_t dir_len = strlen(dir);
+        size_t current_len = strlen(current);
+        if (dir_len >= current_len && strcmp(dir + dir_len - current_len, current) == 0) {
+            return;
+        }
+    }
+
+    // rmdir only removes empty directories, so the first one still in use ends the walk
+    for (int level = 0; level < RECORDING_SHARD_DEPTH; level++) {
+        if (rmdir(dir) != 0) {
+            if (errno != ENOENT) {
+                break;
+            }
+        } else {
+            log_debug("Removed empty recording directory %s", dir);
+        }
+        slash = strrchr(dir, '/');
+        if (!slash) {
+            break;
+        }
+        *slash = '\0';
+    }
+}
@@ -0,0 +1,639 @@
+/**
+ * @file retention_engine.c
+ * @brief Per-stream limits and oldest-first deletion of recordings on each volume
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sqlite3.h>
+
+#include "storage/retention_engine.h"
+#include "storage/recording_layout.h"
+#include "storage/archive_worker.h"
+#include "storage/storage_volumes.h"
+#include "core/logger.h"
+#include "core/config.h"
+#include "database/db_core.h"
+#include "database/db_recordings.h"
+#include "database/db_compaction.h"
+#include "database/db_recording_usage.h"
+#include "database/db_streams.h"
+#include "video/hls_recording.h"
+#include "video/recording_thumbnails.h"
+#include "video/thread_utils.h"
+
+// Seconds between free space checks when nobody asks for one
+#define RETENTION_CHECK_INTERVAL 30
+
+// Recordings fetched per stream at a time, oldest first
+#define RETENTION_FETCH 32
+
+// Recordings deleted before free space is measured again
+#define RETENTION_DELETE_BATCH 32
+
+// Most recordings one pass deletes, in case the file system does not
+// report the space as freed
+#define RETENTION_MAX_PER_PASS 20000
+
+typedef struct {
+    uint64_t id;
+    char file_path[256];
+    time_t start_time;
+    uint64_t size_bytes;
+} retention_candidate_t;
+
+// Oldest finished recordings of one stream not yet deleted
+typedef struct {
+    char stream_name[64];
+    int tier;                 // Lower tiers are emptied first, see retention_tier()
+    time_t age_offset;        // Subtracted from the age; larger for higher priority
+    retention_candidate_t candidates[RETENTION_FETCH];
+    int pos;
+    int count;
+    bool exhausted;           // No recordings after the last candidate
+    bool local_only;          // Skip archived recordings, which free no local space
+    int volume;               // Only recordings on this volume, -1 for all
+    time_t after_time;        // Last recording looked at, candidate or not
+    uint64_t after_id;
+} stream_cursor_t;
+
+static struct {
+    pthread_t thread;
+    bool running;
+    bool pass_requested;
+    char storage_path[256];
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    uint64_t deleted_recordings;
+    uint64_t freed_bytes;
+    time_t last_limits_check;
+} engine = {
+    .running = false,
+    .pass_requested = false,
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER
+};
+
+/**
+ * Get the free and total bytes of a volume's file system
+ * Volume 0 is measured at the storage path, which it normally shares a
+ * disk with.
+ */
+static int get_free_space(int volume, uint64_t *free_bytes, uint64_t *total_bytes) {
+    char path[MAX_PATH_LENGTH];
+    if (volume == 0) {
+        snprintf(path, sizeof(path), "%s", engine.storage_path);
+    } else if (storage_volume_path(volume, path, sizeof(path)) != 0) {
+        return -1;
+    }
+
+    struct statvfs fs;
+    if (statvfs(path, &fs) != 0) {
+        log_error("Failed to get filesystem statistics of %s: %s", path, strerror(errno));
+        return -1;
+    }
+    *free_bytes = (uint64_t)fs.f_bavail * fs.f_frsize;
+    *total_bytes = (uint64_t)fs.f_blocks * fs.f_frsize;
+    return 0;
+}
+
+/**
+ * Fetch the next oldest finished recordings of a stream
+ * Continues after the last recording looked at, by (start_time, id).
+ */
+static void fill_cursor(stream_cursor_t *cursor) {
+    cursor->pos = 0;
+    cursor->count = 0;
+
+    sqlite3 *db = acquire_db_reader();
+    if (!db) {
+        cursor->exhausted = true;
+        return;
+    }
+
+    char archive[MAX_PATH_LENGTH];
+    bool skip_archived = cursor->local_only && get_archive_prefix(archive, sizeof(archive)) == 0;
+
+    const char *sql = skip_archived ?
+                      "SELECT id, file_path, start_time, size_bytes FROM recordings "
+                      "WHERE is_complete = 1 AND stream_id = " STREAM_ID_OF("?") " "
+                      "AND (start_time > ? OR (start_time = ? AND id > ?)) "
+                      "AND substr(file_path, 1, ?) != ? "
+                      "ORDER BY start_time, id LIMIT ?;" :
+                      "SELECT id, file_path, start_time, size_bytes FROM recordings "
+                      "WHERE is_complete = 1 AND stream_id = " STREAM_ID_OF("?") " "
+                      "AND (start_time > ? OR (start_time = ? AND id > ?)) "
+                      "ORDER BY start_time, id LIMIT ?;";
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+        release_db_reader(db);
+        cursor->exhausted = true;
+        return;
+    }
+
+    // Recordings on other volumes are skipped, so a page may yield fewer candidates than it has rows
+    bool table_end = false;
+    while (!table_end && cursor->count < RETENTION_FETCH) {
+        sqlite3_bind_text(stmt, 1, cursor->stream_name, -1, SQLITE_STATIC);
+        sqlite3_bind_int64(stmt, 2, (sqlite3_int64)cursor->after_time);
+        sqlite3_bind_int64(stmt, 3, (sqlite3_int64)cursor->after_time);
+        sqlite3_bind_int64(stmt, 4, (sqlite3_int64)cursor->after_id);
+        if (skip_archived) {
+            sqlite3_bind_int(stmt, 5, (int)strlen(archive));
+            sqlite3_bind_text(stmt, 6, archive, -1, SQLITE_STATIC);
+            sqlite3_bind_int(stmt, 7, RETENTION_FETCH);
+        } else {
+            sqlite3_bind_int(stmt, 5, RETENTION_FETCH);
+        }
+
+        int rows = 0;
+        while (cursor->count < RETENTION_FETCH && sqlite3_step(stmt) == SQLITE_ROW) {
+            rows++;
+            const char *path = (const char *)sqlite3_column_text(stmt, 1);
+            cursor->after_id = (uint64_t)sqlite3_column_int64(stmt, 0);
+            cursor->after_time = (time_t)sqlite3_column_int64(stmt, 2);
+            if (cursor->volume >= 0 && storage_volume_of_path(path) != cursor->volume) {
+                continue;
+            }
+
+            retention_candidate_t *c = &cursor->candidates[cursor->count++];
+            c->id = cursor->after_id;
+            strncpy(c->file_path, path ? path : "", sizeof(c->file_path) - 1);
+            c->file_path[sizeof(c->file_path) - 1] = '\0';
+            c->start_time = cursor->after_time;
+            c->size_bytes = (uint64_t)sqlite3_column_int64(stmt, 3);
+        }
+        table_end = cursor->count < RETENTION_FETCH && rows < RETENTION_FETCH;
+        sqlite3_reset(stmt);
+    }
+    sqlite3_finalize(stmt);
+    release_db_reader(db);
+
+    cursor->exhausted = table_end;
+}
+
+// Eviction key of a stream's next candidate; the smallest goes first
+static time_t cursor_key(const stream_cursor_t *cursor) {
+    return cursor->candidates[cursor->pos].start_time + cursor->age_offset;
+}
+
+// Whether a's next candidate goes before b's
+static bool cursor_before(const stream_cursor_t *a, const stream_cursor_t *b) {
+    if (a->tier != b->tier) {
+        return a->tier < b->tier;
+    }
+    return cursor_key(a) < cursor_key(b);
+}
+
+// Best-effort streams give up space first, critical streams last
+static int retention_tier(retention_class_t retention_class) {
+    switch (retention_class) {
+        case RETENTION_CLASS_BEST_EFFORT:
+            return 0;
+        case RETENTION_CLASS_CRITICAL:
+            return 2;
+        default:
+            return 1;
+    }
+}
+
+static void heap_sift_down(int *heap, int size, int i, const stream_cursor_t *cursors) {
+    for (;;) {
+        int smallest = i;
+        int left = 2 * i + 1;
+        int right = left + 1;
+        if (left < size && cursor_before(&cursors[heap[left]], &cursors[heap[smallest]])) {
+            smallest = left;
+        }
+        if (right < size && cursor_before(&cursors[heap[right]], &cursors[heap[smallest]])) {
+            smallest = right;
+        }
+        if (smallest == i) {
+            return;
+        }
+        int tmp = heap[i];
+        heap[i] = heap[smallest];
+        heap[smallest] = tmp;
+        i = smallest;
+    }
+}
+
+/**
+ * Delete one recording's file and metadata
+ *
+ * @return Bytes freed
+ */
+static uint64_t delete_candidate(const retention_candidate_t *c) {
+    uint64_t freed = c->size_bytes;
+
+    // A compacted recording shares its file; the file is queued for deletion
+    // with the last recording in it, and the recording frees its share
+    if (get_recording_compaction(c->id, NULL) == 1) {
+        if (delete_recording_metadata(c->id) != 0) {
+            log_warn("Failed to delete compacted recording %llu", (unsigned long long)c->id);
+            return 0;
+        }
+        return freed;
+    }
+
+    struct stat st;
+    if (c->file_path[0] && stat(c->file_path, &st) == 0) {
+        // A recording of HLS segments is a directory; its size is in the database
+        if (!hls_recording_is_segmented(c->file_path)) {
+            freed = (uint64_t)st.st_size;
+        }
+        if (hls_recording_unlink(c->file_path) != 0) {
+            log_error("Failed to delete recording %s: %s", c->file_path, strerror(errno));
+            return 0;
+        }
+        recording_thumbnails_remove(c->file_path);
+        recording_layout_prune(c->file_path);
+    }
+    if (delete_recording_metadata(c->id) != 0) {
+        log_warn("Deleted recording file %s but not its metadata", c->file_path);
+    }
+    return freed;
+}
+
+/**
+ * Load the configuration of all streams
+ *
+ * @param count Receives the number of streams
+ * @return Array to free, or NULL if there are none
+ */
+static stream_config_t *load_streams(int *count) {
+    *count = 0;
+    stream_config_t *streams = calloc(MAX_STREAMS, sizeof(stream_config_t));
+    if (!streams) {
+        log_error("Failed to allocate memory for stream configurations");
+        return NULL;
+    }
+
+    int n = get_all_stream_configs(streams, MAX_STREAMS);
+    if (n <= 0) {
+        free(streams);
+        return NULL;
+    }
+    *count = n;
+    return streams;
+}
+
+static const stream_config_t *find_stream(const stream_config_t *streams, int count, const char *name) {
+    for (int i = 0; i < count; i++) {
+        if (strcmp(streams[i].name, name) == 0) {
+            return &streams[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Delete the oldest recordings of one stream
+ * Deletes while recordings start before the cutoff or the stream is over
+ * its quota.
+ *
+ * @param stream_name Stream name
+ * @param cutoff Recordings starting before this are deleted (0 for none)
+ * @param excess Bytes over the stream's quota (0 for none)
+ * @param freed Incremented by the bytes freed
+ * @return Number of recordings deleted
+ */
+static int trim_stream(const char *stream_name, time_t cutoff, uint64_t excess, uint64_t *freed) {
+    stream_cursor_t *cursor = calloc(1, sizeof(stream_cursor_t));
+    if (!cursor) {
+        log_error("Failed to allocate memory for retention");
+        return 0;
+    }
+    strncpy(cursor->stream_name, stream_name, sizeof(cursor->stream_name) - 1);
+    cursor->volume = -1;
+
+    int deleted = 0;
+    fill_cursor(cursor);
+    while (cursor->pos < cursor->count && deleted < RETENTION_MAX_PER_PASS) {
+        const retention_candidate_t *c = &cursor->candidates[cursor->pos];
+        if (c->start_time >= cutoff && excess == 0) {
+            break;
+        }
+
+        // The quota is counted in the sizes the database holds, as the totals are
+        log_debug("Deleting recording %s past the limits of stream %s", c->file_path, stream_name);
+        *freed += delete_candidate(c);
+        excess = excess > c->size_bytes ? excess - c->size_bytes : 0;
+        deleted++;
+
+        cursor->pos++;
+        if (cursor->pos == cursor->count && !cursor->exhausted) {
+            fill_cursor(cursor);
+        }
+    }
+
+    free(cursor);
+    return deleted;
+}
+
+/**
+ * Delete recordings of streams past their own retention days or quota
+ */
+static void enforce_stream_limits(time_t now) {
+    recording_usage_t usage[MAX_USAGE_STREAMS];
+    int usage_count = get_recording_usage(usage, MAX_USAGE_STREAMS);
+    if (usage_count <= 0) {
+        return;
+    }
+
+    int stream_count;
+    stream_config_t *streams = load_streams(&stream_count);
+    if (!streams) {
+        return;
+    }
+
+    int deleted = 0;
+    uint64_t freed = 0;
+    for (int i = 0; i < usage_count; i++) {
+        const stream_config_t *stream = find_stream(streams, stream_count, usage[i].stream_name);
+        if (!stream) {
+            continue;
+        }
+
+        time_t cutoff = 0;
+        if (stream->retention_days > 0 && usage[i].oldest_time > 0 &&
+            usage[i].oldest_time < now - (time_t)stream->retention_days * 86400) {
+            cutoff = now - (time_t)stream->retention_days * 86400;
+        }
+        uint64_t excess = 0;
+        if (stream->max_storage_bytes > 0 && usage[i].size_bytes > stream->max_storage_bytes) {
+            excess = usage[i].size_bytes - stream->max_storage_bytes;
+        }
+        if (cutoff == 0 && excess == 0) {
+            continue;
+        }
+
+        int n = trim_stream(stream->name, cutoff, excess, &freed);
+        if (n > 0) {
+            log_info("Deleted %d recordings of stream %s past its %d days or %llu byte quota",
+                     n, stream->name, stream->retention_days, (unsigned long long)stream->max_storage_bytes);
+        }
+        deleted += n;
+    }
+    free(streams);
+
+    pthread_mutex_lock(&engine.mutex);
+    engine.deleted_recordings += deleted;
+    engine.freed_bytes += freed;
+    pthread_mutex_unlock(&engine.mutex);
+}
+
+/**
+ * Delete recordings on a volume oldest first across streams until enough
+ * space is free
+ *
+ * @param volume Index of the volume
+ * @param target_free Free bytes to reach
+ * @return Number of recordings deleted
+ */
+static int evict_until(int volume, uint64_t target_free) {
+    recording_usage_t usage[MAX_USAGE_STREAMS];
+    int stream_count = get_recording_usage(usage, MAX_USAGE_STREAMS);
+    if (stream_count <= 0) {
+        log_warn("Free space is low, but no recordings are known to delete");
+        return 0;
+    }
+
+    stream_cursor_t *cursors = calloc(stream_count, sizeof(stream_cursor_t));
+    int *heap = calloc(stream_count, sizeof(int));
+    if (!cursors || !heap) {
+        log_error("Failed to allocate memory for retention");
+        free(cursors);
+        free(heap);
+        return 0;
+    }
+
+    int config_count;
+    stream_config_t *streams = load_streams(&config_count);
+
+    // One heap entry per stream that has a finished recording
+    int heap_size = 0;
+    for (int i = 0; i < stream_count; i++) {
+        stream_cursor_t *cursor = &cursors[i];
+        strncpy(cursor->stream_name, usage[i].stream_name, sizeof(cursor->stream_name) - 1);
+        cursor->local_only = true;
+        cursor->volume = storage_volumes_count() > 1 ? volume : -1;
+
+        const stream_config_t *stream = find_stream(streams, config_count, cursor->stream_name);
+        int priority = 1;
+        if (stream) {
+            cursor->tier = retention_tier(stream->retention_class);
+            if (g_config.retention_priority_hours > 0 && stream->priority > 1) {
+                priority = stream->priority;
+            }
+        } else {
+            cursor->tier = retention_tier(RETENTION_CLASS_NORMAL);
+        }
+        cursor->age_offset = (time_t)(priority - 1) * g_config.retention_priority_hours * 3600;
+
+        fill_cursor(cursor);
+        if (cursor->count > 0) {
+            heap[heap_size++] = i;
+        }
+    }
+    free(streams);
+    for (int i = heap_size / 2 - 1; i >= 0; i--) {
+        heap_sift_down(heap, heap_size, i, cursors);
+    }
+
+    int deleted = 0;
+    uint64_t freed = 0;
+    bool critical_warned = false;
+    while (heap_size > 0 && deleted < RETENTION_MAX_PER_PASS) {
+        // Take a batch in exact heap order, then measure again
+        retention_candidate_t batch[RETENTION_DELETE_BATCH];
+        int batch_count = 0;
+        while (heap_size > 0 && batch_count < RETENTION_DELETE_BATCH) {
+            stream_cursor_t *cursor = &cursors[heap[0]];
+            if (cursor->tier == retention_tier(RETENTION_CLASS_CRITICAL) && !critical_warned) {
+                log_warn("Only recordings of critical streams are left, deleting from %s", cursor->stream_name);
+                critical_warned = true;
+            }
+            batch[batch_count++] = cursor->candidates[cursor->pos++];
+
+            if (cursor->pos == cursor->count && !cursor->exhausted) {
+                fill_cursor(cursor);
+            }
+            if (cursor->pos >= cursor->count) {
+                heap[0] = heap[--heap_size];
+            }
+            heap_sift_down(heap, heap_size, 0, cursors);
+        }
+
+        for (int i = 0; i < batch_count; i++) {
+            log_debug("Deleting recording %s to free space", batch[i].file_path);
+            freed += delete_candidate(&batch[i]);
+            deleted++;
+        }
+
+        uint64_t free_bytes, total_bytes;
+        if (get_free_space(volume, &free_bytes, &total_bytes) != 0 || free_bytes >= target_free) {
+            break;
+        }
+    }
+
+    free(cursors);
+    free(heap);
+
+    pthread_mutex_lock(&engine.mutex);
+    engine.deleted_recordings += deleted;
+    engine.freed_bytes += freed;
+    pthread_mutex_unlock(&engine.mutex);
+
+    log_info("Retention deleted %d recordings, freeing %llu bytes", deleted, (unsigned long long)freed);
+    return deleted;
+}
+
+/**
+ * Check the free space of a volume and delete its oldest recordings if it is low
+ */
+static void check_volume(int volume) {
+    uint64_t free_bytes, total_bytes;
+    if (get_free_space(volume, &free_bytes, &total_bytes) != 0 || total_bytes == 0) {
+        return;
+    }
+
+    uint64_t low = total_bytes / 100 * g_config.min_free_percent;
+    if (free_bytes >= low) {
+        return;
+    }
+
+    int target_percent = g_config.target_free_percent > g_config.min_free_percent ?
+                         g_config.target_free_percent : g_config.min_free_percent;
+    uint64_t target = total_bytes / 100 * target_percent;
+
+    char path[MAX_PATH_LENGTH];
+    if (volume == 0 || storage_volume_path(volume, path, sizeof(path)) != 0) {
+        snprintf(path, sizeof(path), "%s", engine.storage_path);
+    }
+    log_warn("Free space on %s is %llu of %llu bytes, deleting the oldest recordings up to %d%% free",
+             path, (unsigned long long)free_bytes, (unsigned long long)total_bytes, target_percent);
+    evict_until(volume, target);
+}
+
+/**
+ * Check free space and delete the oldest recordings where it is low
+ */
+static void run_retention_pass(void) {
+    if (!get_db_handle()) {
+        return;
+    }
+
+    // Quotas and per-stream retention hold whether or not the disk is full
+    time_t now = time(NULL);
+    if (now - engine.last_limits_check >= RETENTION_CHECK_INTERVAL) {
+        engine.last_limits_check = now;
+        enforce_stream_limits(now);
+    }
+
+    if (!g_config.auto_delete_oldest || g_config.min_free_percent <= 0) {
+        return;
+    }
+
+    // Each volume is its own disk, so one filling up only deletes recordings on it
+    int volumes = storage_volumes_count();
+    for (int i = 0; i < volumes; i++) {
+        check_volume(i);
+    }
+}
+
+static void *retention_engine_thread(void *arg) {
+    (void)arg;
+    thread_set_identity(THREAD_CLASS_SERVICE, "retention", NULL);
+    log_info("Retention engine started for %s", engine.storage_path);
+
+    pthread_mutex_lock(&engine.mutex);
+    while (engine.running) {
+        if (!engine.pass_requested) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += RETENTION_CHECK_INTERVAL;
+            pthread_cond_timedwait(&engine.cond, &engine.mutex, &deadline);
+        }
+        if (!engine.running) {
+            break;
+        }
+        engine.pass_requested = false;
+        pthread_mutex_unlock(&engine.mutex);
+
+        run_retention_pass();
+
+        pthread_mutex_lock(&engine.mutex);
+    }
+    pthread_mutex_unlock(&engine.mutex);
+
+    log_info("Retention engine stopped");
+    return NULL;
+}
+
+int start_retention_engine(const char *storage_path) {
+    if (!storage_path) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&engine.mutex);
+    if (engine.running) {
+        pthread_mutex_unlock(&engine.mutex);
+        return 0;
+    }
+
+    strncpy(engine.storage_path, storage_path, sizeof(engine.storage_path) - 1);
+    engine.storage_path[sizeof(engine.storage_path) - 1] = '\0';
+    engine.running = true;
+    engine.pass_requested = true;
+
+    if (pthread_create(&engine.thread, NULL, retention_engine_thread, NULL) != 0) {
+        log_error("Failed to create retention engine thread: %s", strerror(errno));
+        engine.running = false;
+        pthread_mutex_unlock(&engine.mutex);
+        return -1;
+    }
+    pthread_mutex_unlock(&engine.mutex);
+    return 0;
+}
+
+void stop_retention_engine(void) {
+    pthread_mutex_lock(&engine.mutex);
+    if (!engine.running) {
+        pthread_mutex_unlock(&engine.mutex);
+        return;
+    }
+    engine.running = false;
+    pthread_cond_signal(&engine.cond);
+    pthread_mutex_unlock(&engine.mutex);
+
+    pthread_join(engine.thread, NULL);
+}
+
+void request_retention_pass(void) {
+    pthread_mutex_lock(&engine.mutex);
+    engine.pass_requested = true;
+    pthread_cond_signal(&engine.cond);
+    pthread_mutex_unlock(&engine.mutex);
+}
+
+void get_retention_engine_stats(uint64_t *recordings, uint64_t *bytes) {
+    pthread_mutex_lock(&engine.mutex);
+    if (recordings) {
+        *recordings = engine.deleted_recordings;
+    }
+    if (bytes) {
+        *bytes = engine.freed_bytes;
+    }
+    pthread_mutex_unlock(&engine.mutex);
+}
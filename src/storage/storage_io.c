@@ -0,0 +1,994 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+#include <libavformat/avformat.h>
+#include <libavutil/mem.h>
+
+#include "core/logger.h"
+#include "core/config.h"
+#include "storage/storage_io.h"
+#include "storage/storage_latency.h"
+#include "video/thread_utils.h"
+
+// Disks with their own I/O thread; files on further disks are written directly
+#define STORAGE_IO_MAX_DEVICES 8
+
+// Free chunks kept per disk for reuse
+#define STORAGE_IO_FREE_CHUNKS 8
+
+// Data written since the last fdatasync after which the I/O thread syncs and drops the pages
+#define STORAGE_IO_SYNC_INTERVAL (4 * 1024 * 1024)
+
+// A partly filled chunk is queued once its oldest data is this old, so a crash
+// loses at most this much more than what the muxer had flushed
+#define STORAGE_IO_MAX_DELAY_MS 1000
+
+// On a disk rated slow (see storage_latency.h) the sync interval and the delay
+// of partly filled chunks grow by this factor, so it gets fewer, larger writes
+#define STORAGE_IO_SLOW_FACTOR 4
+
+// Buffer of the AVIOContext in front of a file
+#define STORAGE_IO_AVIO_BUFFER_SIZE 32768
+
+#ifdef HAVE_LIBURING
+// Operations the I/O thread submits to the ring at once
+#define STORAGE_IO_RING_DEPTH 64
+
+// Chunks with buffers registered with the ring: a full queue plus one being
+// filled for each of a few files
+#define STORAGE_IO_FIXED_CHUNKS (STORAGE_IO_QUEUE_LIMIT / STORAGE_IO_CHUNK_SIZE + 16)
+#endif
+
+typedef enum {
+    IO_OP_WRITE,
+    IO_OP_FALLOCATE             // Reserve offset bytes, no data
+} io_op_t;
+
+typedef struct io_chunk {
+    struct io_chunk *next;
+    storage_io_file_t *file;
+    io_op_t op;
+    int64_t offset;
+    size_t size;
+    int64_t created_ms;         // When the first byte was copied in
+    uint8_t *data;              // STORAGE_IO_CHUNK_SIZE bytes, page aligned
+    int buf_index;              // Buffer registered with the ring, -1 if none
+} io_chunk_t;
+
+typedef struct {
+    bool used;
+    bool running;
+    dev_t device;
+    int latency_slot;           // Slot in the latency monitor, -1 if none
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t work_cond;   // Signaled when a chunk is queued or the thread has to stop
+    pthread_cond_t done_cond;   // Signaled when a chunk has been written
+    io_chunk_t *head;
+    io_chunk_t *tail;
+    size_t queued_bytes;
+    io_chunk_t *free_chunks;
+    int free_count;
+#ifdef HAVE_LIBURING
+    struct io_uring ring;
+    bool ring_ready;            // Otherwise the thread uses plain system calls
+    io_chunk_t *fixed_chunks;   // STORAGE_IO_FIXED_CHUNKS with registered buffers, or NULL
+    io_chunk_t *fixed_free;
+#endif
+} io_device_t;
+
+struct storage_io_file {
+    io_device_t *device;
+    int fd;
+    char path[MAX_PATH_LENGTH];
+    io_chunk_t *current;        // Chunk being filled by the writer
+    int64_t position;           // Position of the next write
+    int64_t size;               // End of the furthest write
+    bool preallocated;          // Set by the I/O thread, read once nothing is pending
+    int pending;                // Chunks queued, under the device mutex
+    int error;                  // First write error (errno), under the device mutex
+    int64_t unsynced;           // Bytes written since the last sync, I/O thread only
+};
+
+static io_device_t devices[STORAGE_IO_MAX_DEVICES];
+static pthread_mutex_t devices_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static int64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * Data written to a file of a disk between syncs
+ */
+static int64_t sync_interval(const io_device_t *device) {
+    return storage_latency_level(device->latency_slot) >= STORAGE_LATENCY_SLOW ?
+           (int64_t)STORAGE_IO_SYNC_INTERVAL * STORAGE_IO_SLOW_FACTOR : STORAGE_IO_SYNC_INTERVAL;
+}
+
+/**
+ * Age at which a partly filled chunk of a disk is queued
+ */
+static int64_t max_delay_ms(const io_device_t *device) {
+    return storage_latency_level(device->latency_slot) >= STORAGE_LATENCY_SLOW ?
+           (int64_t)STORAGE_IO_MAX_DELAY_MS * STORAGE_IO_SLOW_FACTOR : STORAGE_IO_MAX_DELAY_MS;
+}
+
+/**
+ * Sync a file and time it
+ */
+static void sync_file(storage_io_file_t *file) {
+    int slot = file->device->latency_slot;
+    uint64_t started = storage_latency_begin(slot);
+    fdatasync(file->fd);
+    storage_latency_end(slot, STORAGE_OP_SYNC, started);
+}
+
+/**
+ * Get a chunk from the free list of a disk or allocate one
+ */
+static io_chunk_t *get_chunk(io_device_t *device) {
+    pthread_mutex_lock(&device->mutex);
+    io_chunk_t *chunk = NULL;
+#ifdef HAVE_LIBURING
+    chunk = device->fixed_free;
+    if (chunk) {
+        device->fixed_free = chunk->next;
+    }
+#endif
+    if (!chunk) {
+        chunk = device->free_chunks;
+        if (chunk) {
+            device->free_chunks = chunk->next;
+            device->free_count--;
+        }
+    }
+    pthread_mutex_unlock(&device->mutex);
+
+    if (!chunk) {
+        chunk = calloc(1, sizeof(io_chunk_t));
+        if (!chunk) {
+            return NULL;
+        }
+        if (posix_memalign((void **)&chunk->data, 4096, STORAGE_IO_CHUNK_SIZE) != 0) {
+            free(chunk);
+            return NULL;
+        }
+        chunk->buf_index = -1;
+    }
+
+    chunk->next = NULL;
+    chunk->file = NULL;
+    chunk->op = IO_OP_WRITE;
+    chunk->offset = 0;
+    chunk->size = 0;
+    chunk->created_ms = 0;
+    return chunk;
+}
+
+/**
+ * Return a chunk to the free list of a disk
+ * Must be called with the device mutex held.
+ */
+static void put_chunk_locked(io_device_t *device, io_chunk_t *chunk) {
+#ifdef HAVE_LIBURING
+    if (chunk->buf_index >= 0) {
+        chunk->next = device->fixed_free;
+        device->fixed_free = chunk;
+        return;
+    }
+#endif
+    if (!chunk->data) {
+        free(chunk);
+        return;
+    }
+    if (device->free_count < STORAGE_IO_FREE_CHUNKS) {
+        chunk->next = device->free_chunks;
+        device->free_chunks = chunk;
+        device->free_count++;
+        return;
+    }
+    free(chunk->data);
+    free(chunk);
+}
+
+/**
+ * Write the rest of a chunk from an offset within it
+ */
+static int write_chunk_from(io_chunk_t *chunk, size_t written) {
+    storage_io_file_t *file = chunk->file;
+
+    while (written < chunk->size) {
+        ssize_t ret = pwrite(file->fd, chunk->data + written, chunk->size - written,
+                             (off_t)(chunk->offset + written));
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno;
+        }
+        written += (size_t)ret;
+    }
+    return 0;
+}
+
+/**
+ * Run a queued operation with plain system calls
+ * Runs on the I/O thread without the device mutex.
+ */
+static int run_chunk(io_chunk_t *chunk) {
+    storage_io_file_t *file = chunk->file;
+
+    if (chunk->op == IO_OP_FALLOCATE) {
+        file->preallocated = fallocate(file->fd, FALLOC_FL_KEEP_SIZE, 0, (off_t)chunk->offset) == 0;
+        return 0;
+    }
+
+    int slot = file->device->latency_slot;
+    uint64_t started = storage_latency_begin(slot);
+    int error = write_chunk_from(chunk, 0);
+    storage_latency_end(slot, STORAGE_OP_WRITE, started);
+    if (error) {
+        return error;
+    }
+
+    // Periodically push the data out and drop it from the page cache; pages that
+    // are still dirty are skipped by DONTNEED, hence the sync first
+    file->unsynced += (int64_t)chunk->size;
+    if (file->unsynced >= sync_interval(file->device)) {
+        sync_file(file);
+        posix_fadvise(file->fd, 0, 0, POSIX_FADV_DONTNEED);
+        file->unsynced = 0;
+    }
+    return 0;
+}
+
+/**
+ * Finish a queued operation
+ * Must be called with the device mutex held.
+ */
+static void complete_chunk_locked(io_device_t *device, io_chunk_t *chunk, int error) {
+    storage_io_file_t *file = chunk->file;
+    if (error && !file->error) {
+        file->error = error;
+        log_error("Write to %s failed: %s", file->path, strerror(error));
+    }
+    file->pending--;
+    device->queued_bytes -= chunk->size;
+    put_chunk_locked(device, chunk);
+}
+
+#ifdef HAVE_LIBURING
+/**
+ * Set up the ring of a disk and register the buffers of its fixed chunks
+ * Without a ring (old kernel, io_uring disabled by sysctl or seccomp) the
+ * thread uses plain system calls; without registered buffers (locked memory
+ * limit) it submits ordinary writes.
+ */
+static void setup_ring(io_device_t *device) {
+    int ret = io_uring_queue_init(STORAGE_IO_RING_DEPTH, &device->ring, 0);
+    if (ret < 0) {
+        log_warn("io_uring not available for device %lu (%s), using system calls",
+                (unsigned long)device->device, strerror(-ret));
+        return;
+    }
+    device->ring_ready = true;
+
+    io_chunk_t *chunks = calloc(STORAGE_IO_FIXED_CHUNKS, sizeof(io_chunk_t));
+    struct iovec *iov = calloc(STORAGE_IO_FIXED_CHUNKS, sizeof(struct iovec));
+    int allocated = 0;
+    if (chunks && iov) {
+        for (; allocated < STORAGE_IO_FIXED_CHUNKS; allocated++) {
+            if (posix_memalign((void **)&chunks[allocated].data, 4096, STORAGE_IO_CHUNK_SIZE) != 0) {
+                break;
+            }
+            iov[allocated].iov_base = chunks[allocated].data;
+            iov[allocated].iov_len = STORAGE_IO_CHUNK_SIZE;
+        }
+    }
+
+    ret = -ENOMEM;
+    if (allocated == STORAGE_IO_FIXED_CHUNKS) {
+        ret = io_uring_register_buffers(&device->ring, iov, STORAGE_IO_FIXED_CHUNKS);
+    }
+    free(iov);
+
+    if (ret < 0) {
+        log_info("Storage I/O of device %lu uses io_uring without registered buffers: %s",
+                (unsigned long)device->device, strerror(-ret));
+        for (int i = 0; i < allocated; i++) {
+            free(chunks[i].data);
+        }
+        free(chunks);
+        return;
+    }
+
+    for (int i = STORAGE_IO_FIXED_CHUNKS - 1; i >= 0; i--) {
+        chunks[i].buf_index = i;
+        chunks[i].next = device->fixed_free;
+        device->fixed_free = &chunks[i];
+    }
+    device->fixed_chunks = chunks;
+    log_info("Storage I/O of device %lu uses io_uring with %d registered buffers",
+            (unsigned long)device->device, STORAGE_IO_FIXED_CHUNKS);
+}
+
+/**
+ * Release the ring of a disk, once its thread has stopped
+ */
+static void teardown_ring(io_device_t *device) {
+    if (device->ring_ready) {
+        if (device->fixed_chunks) {
+            io_uring_unregister_buffers(&device->ring);
+        }
+        io_uring_queue_exit(&device->ring);
+        device->ring_ready = false;
+    }
+    if (device->fixed_chunks) {
+        for (int i = 0; i < STORAGE_IO_FIXED_CHUNKS; i++) {
+            free(device->fixed_chunks[i].data);
+        }
+        free(device->fixed_chunks);
+        device->fixed_chunks = NULL;
+        device->fixed_free = NULL;
+    }
+}
+
+/**
+ * Check whether a write overlaps one already in the batch
+ * Writes in a batch may complete in any order, so a rewrite of the same
+ * range (an MP4 header, say) waits for the next batch.
+ */
+static bool overlaps_batch(io_chunk_t **batch, int count, const io_chunk_t *chunk) {
+    for (int i = 0; i < count; i++) {
+        if (batch[i]->file == chunk->file && batch[i]->op == IO_OP_WRITE && chunk->op == IO_OP_WRITE &&
+            batch[i]->offset < chunk->offset + (int64_t)chunk->size &&
+            chunk->offset < batch[i]->offset + (int64_t)batch[i]->size) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Wait for the completions of a submission
+ *
+ * @return Number of completions reaped
+ */
+static int reap_completions(io_device_t *device, int count, int *results) {
+    int reaped = 0;
+    while (reaped < count) {
+        struct io_uring_cqe *cqe;
+        int ret = io_uring_wait_cqe(&device->ring, &cqe);
+        if (ret == -EINTR) {
+            continue;
+        }
+        if (ret < 0) {
+            break;
+        }
+        results[(uintptr_t)io_uring_cqe_get_data(cqe)] = cqe->res;
+        io_uring_cqe_seen(&device->ring, cqe);
+        reaped++;
+    }
+    return reaped;
+}
+
+/**
+ * Run a batch of queued operations through the ring
+ * Writes and fallocates go in one submission; the data syncs that become due
+ * go in a second one once the writes are done. Runs on the I/O thread without
+ * the device mutex.
+ *
+ * @return 0, or -1 if the ring failed and the batch has to be run with system calls
+ */
+static int run_batch(io_device_t *device, io_chunk_t **batch, int count, int *errors) {
+    int results[STORAGE_IO_RING_DEPTH];
+
+    for (int i = 0; i < count; i++) {
+        io_chunk_t *chunk = batch[i];
+        struct io_uring_sqe *sqe = io_uring_get_sqe(&device->ring);
+        if (chunk->op == IO_OP_FALLOCATE) {
+            io_uring_prep_fallocate(sqe, chunk->file->fd, FALLOC_FL_KEEP_SIZE, 0, (off_t)chunk->offset);
+        } else if (chunk->buf_index >= 0) {
+            io_uring_prep_write_fixed(sqe, chunk->file->fd, chunk->data, (unsigned)chunk->size,
+                                      (off_t)chunk->offset, chunk->buf_index);
+        } else {
+            io_uring_prep_write(sqe, chunk->file->fd, chunk->data, (unsigned)chunk->size,
+                                (off_t)chunk->offset);
+        }
+        io_uring_sqe_set_data(sqe, (void *)(uintptr_t)i);
+        results[i] = -ECANCELED;
+    }
+
+    // The whole batch is timed as one write: it is what the queue waits for
+    uint64_t started = storage_latency_begin(device->latency_slot);
+    int ret = io_uring_submit(&device->ring);
+    if (ret < count) {
+        log_error("io_uring submission failed for device %lu (%s), using system calls",
+                 (unsigned long)device->device, strerror(ret < 0 ? -ret : EIO));
+        // The ring is dropped after what was submitted completes, so no write lands later
+        reap_completions(device, ret > 0 ? ret : 0, results);
+        storage_latency_end(device->latency_slot, STORAGE_OP_WRITE, started);
+        return -1;
+    }
+    reap_completions(device, count, results);
+    storage_latency_end(device->latency_slot, STORAGE_OP_WRITE, started);
+
+    storage_io_file_t *sync_files[STORAGE_IO_RING_DEPTH];
+    int sync_count = 0;
+
+    for (int i = 0; i < count; i++) {
+        io_chunk_t *chunk = batch[i];
+        storage_io_file_t *file = chunk->file;
+        int res = results[i];
+        errors[i] = 0;
+
+        if (chunk->op == IO_OP_FALLOCATE) {
+            file->preallocated = res == 0;
+            continue;
+        }
+
+        if (res < 0) {
+            errors[i] = -res;
+            continue;
+        }
+        // A short write is finished the slow way
+        if ((size_t)res < chunk->size) {
+            errors[i] = write_chunk_from(chunk, (size_t)res);
+            if (errors[i]) {
+                continue;
+            }
+        }
+
+        file->unsynced += (int64_t)chunk->size;
+        if (file->unsynced >= sync_interval(device)) {
+            file->unsynced = 0;
+            sync_files[sync_count++] = file;
+        }
+    }
+
+    if (sync_count > 0) {
+        started = storage_latency_begin(device->latency_slot);
+        for (int i = 0; i < sync_count; i++) {
+            struct io_uring_sqe *sqe = io_uring_get_sqe(&device->ring);
+            io_uring_prep_fsync(sqe, sync_files[i]->fd, IORING_FSYNC_DATASYNC);
+            io_uring_sqe_set_data(sqe, (void *)(uintptr_t)i);
+        }
+        ret = io_uring_submit(&device->ring);
+        reap_completions(device, ret > 0 ? ret : 0, results);
+        for (int i = ret > 0 ? ret : 0; i < sync_count; i++) {
+            fdatasync(sync_files[i]->fd);
+        }
+        storage_latency_end(device->latency_slot, STORAGE_OP_SYNC, started);
+        // Dropping the synced pages is cheap enough to do directly
+        for (int i = 0; i < sync_count; i++) {
+            posix_fadvise(sync_files[i]->fd, 0, 0, POSIX_FADV_DONTNEED);
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * I/O thread of a disk with a ring
+ * Takes everything queued, up to the ring depth, and runs it as one batch.
+ */
+static void io_thread_ring(io_device_t *device) {
+    io_chunk_t *batch[STORAGE_IO_RING_DEPTH];
+    int errors[STORAGE_IO_RING_DEPTH];
+
+    pthread_mutex_lock(&device->mutex);
+    while (true) {
+        while (!device->head && device->running) {
+            pthread_cond_wait(&device->work_cond, &device->mutex);
+        }
+        if (!device->head) {
+            // Stopped with an empty queue
+            break;
+        }
+
+        int count = 0;
+        while (device->head && count < STORAGE_IO_RING_DEPTH &&
+               !overlaps_batch(batch, count, device->head)) {
+            batch[count++] = device->head;
+            device->head = device->head->next;
+        }
+        if (!device->head) {
+            device->tail = NULL;
+        }
+        pthread_mutex_unlock(&device->mutex);
+
+        if (run_batch(device, batch, count, errors) != 0) {
+            // Left to the system calls from here on; the fixed chunks stay in
+            // use as ordinary ones and are freed at shutdown
+            io_uring_queue_exit(&device->ring);
+            device->ring_ready = false;
+            for (int i = 0; i < count; i++) {
+                errors[i] = run_chunk(batch[i]);
+            }
+        }
+
+        pthread_mutex_lock(&device->mutex);
+        for (int i = 0; i < count; i++) {
+            complete_chunk_locked(device, batch[i], errors[i]);
+        }
+        pthread_cond_broadcast(&device->done_cond);
+
+        if (!device->ring_ready) {
+            pthread_mutex_unlock(&device->mutex);
+            return;
+        }
+    }
+    pthread_mutex_unlock(&device->mutex);
+}
+#endif
+
+/**
+ * I/O thread of a disk
+ */
+static void *io_thread(void *arg) {
+    io_device_t *device = (io_device_t *)arg;
+    thread_set_identity(THREAD_CLASS_SERVICE, "storage-io", NULL);
+
+#ifdef HAVE_LIBURING
+    if (device->ring_ready) {
+        io_thread_ring(device);
+        if (device->ring_ready) {
+            return NULL;
+        }
+    }
+#endif
+
+    pthread_mutex_lock(&device->mutex);
+    while (true) {
+        while (!device->head && device->running) {
+            pthread_cond_wait(&device->work_cond, &device->mutex);
+        }
+
+        io_chunk_t *chunk = device->head;
+        if (!chunk) {
+            // Stopped with an empty queue
+            break;
+        }
+
+        device->head = chunk->next;
+        if (!device->head) {
+            device->tail = NULL;
+        }
+        pthread_mutex_unlock(&device->mutex);
+
+        int error = run_chunk(chunk);
+
+        pthread_mutex_lock(&device->mutex);
+        complete_chunk_locked(device, chunk, error);
+        pthread_cond_broadcast(&device->done_cond);
+    }
+    pthread_mutex_unlock(&device->mutex);
+
+    return NULL;
+}
+
+/**
+ * Get the I/O thread of a disk, starting it on first use
+ */
+static io_device_t *get_device(dev_t dev) {
+    pthread_mutex_lock(&devices_mutex);
+
+    io_device_t *free_slot = NULL;
+    for (int i = 0; i < STORAGE_IO_MAX_DEVICES; i++) {
+        if (devices[i].used && devices[i].device == dev) {
+            pthread_mutex_unlock(&devices_mutex);
+            return &devices[i];
+        }
+        if (!devices[i].used && !free_slot) {
+            free_slot = &devices[i];
+        }
+    }
+
+    if (!free_slot) {
+        pthread_mutex_unlock(&devices_mutex);
+        return NULL;
+    }
+
+    memset(free_slot, 0, sizeof(io_device_t));
+    free_slot->device = dev;
+    free_slot->latency_slot = storage_latency_register(dev);
+    free_slot->running = true;
+    pthread_mutex_init(&free_slot->mutex, NULL);
+    pthread_cond_init(&free_slot->work_cond, NULL);
+    pthread_cond_init(&free_slot->done_cond, NULL);
+#ifdef HAVE_LIBURING
+    setup_ring(free_slot);
+#endif
+
+    if (pthread_create(&free_slot->thread, NULL, io_thread, free_slot) != 0) {
+        log_error("Failed to start storage I/O thread for device %lu", (unsigned long)dev);
+#ifdef HAVE_LIBURING
+        teardown_ring(free_slot);
+#endif
+        pthread_mutex_destroy(&free_slot->mutex);
+        pthread_cond_destroy(&free_slot->work_cond);
+        pthread_cond_destroy(&free_slot->done_cond);
+        pthread_mutex_unlock(&devices_mutex);
+        return NULL;
+    }
+
+    free_slot->used = true;
+    log_info("Started storage I/O thread for device %lu", (unsigned long)dev);
+
+    pthread_mutex_unlock(&devices_mutex);
+    return free_slot;
+}
+
+/**
+ * Append an operation to the queue of a disk
+ * Must be called with the device mutex held.
+ */
+static void queue_chunk_locked(io_device_t *device, storage_io_file_t *file, io_chunk_t *chunk) {
+    chunk->file = file;
+    chunk->next = NULL;
+    if (device->tail) {
+        device->tail->next = chunk;
+    } else {
+        device->head = chunk;
+    }
+    device->tail = chunk;
+    device->queued_bytes += chunk->size;
+    file->pending++;
+
+    pthread_cond_signal(&device->work_cond);
+}
+
+/**
+ * Queue the current chunk of a file
+ * Waits while the queue of the disk is full.
+ */
+static void submit_current(storage_io_file_t *file) {
+    io_chunk_t *chunk = file->current;
+    file->current = NULL;
+    if (!chunk) {
+        return;
+    }
+
+    io_device_t *device = file->device;
+    pthread_mutex_lock(&device->mutex);
+
+    if (chunk->size == 0) {
+        put_chunk_locked(device, chunk);
+        pthread_mutex_unlock(&device->mutex);
+        return;
+    }
+
+    if (device->queued_bytes + chunk->size > STORAGE_IO_QUEUE_LIMIT && device->running) {
+        // The disk is so far behind that the recorder stalls; frames drop next
+        storage_latency_writer_waited(device->latency_slot);
+    }
+    while (device->queued_bytes + chunk->size > STORAGE_IO_QUEUE_LIMIT && device->running) {
+        pthread_cond_wait(&device->done_cond, &device->mutex);
+    }
+
+    queue_chunk_locked(device, file, chunk);
+    pthread_mutex_unlock(&device->mutex);
+}
+
+/**
+ * Create a file written through the I/O thread of its disk
+ */
+storage_io_file_t *storage_io_open(const char *path, int64_t expected_size) {
+    if (!path) {
+        return NULL;
+    }
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        log_error("Failed to create %s: %s", path, strerror(errno));
+        return NULL;
+    }
+
+    struct stat st;
+    io_device_t *device = fstat(fd, &st) == 0 ? get_device(st.st_dev) : NULL;
+    if (!device) {
+        close(fd);
+        return NULL;
+    }
+
+    storage_io_file_t *file = calloc(1, sizeof(storage_io_file_t));
+    if (!file) {
+        close(fd);
+        return NULL;
+    }
+
+    file->device = device;
+    file->fd = fd;
+    strncpy(file->path, path, MAX_PATH_LENGTH - 1);
+    file->path[MAX_PATH_LENGTH - 1] = '\0';
+
+    // Reserve the blocks up front so the file is not fragmented on disk; KEEP_SIZE
+    // leaves the visible size alone, so an interrupted file has no zero tail.
+    // Filesystems without fallocate (vfat) simply skip this. The I/O thread does
+    // it ahead of the first write, so allocating the extents does not hold up
+    // the recorder.
+    if (expected_size > 0) {
+        io_chunk_t *chunk = calloc(1, sizeof(io_chunk_t));
+        if (chunk) {
+            chunk->op = IO_OP_FALLOCATE;
+            chunk->offset = expected_size;
+            chunk->buf_index = -1;
+            pthread_mutex_lock(&device->mutex);
+            queue_chunk_locked(device, file, chunk);
+            pthread_mutex_unlock(&device->mutex);
+        }
+    }
+
+    return file;
+}
+
+/**
+ * Queue data at the current position
+ */
+int storage_io_write(storage_io_file_t *file, const uint8_t *data, int size) {
+    if (!file || !data || size < 0) {
+        return AVERROR(EINVAL);
+    }
+
+    pthread_mutex_lock(&file->device->mutex);
+    int error = file->error;
+    pthread_mutex_unlock(&file->device->mutex);
+    if (error) {
+        return AVERROR(error);
+    }
+
+    int remaining = size;
+    while (remaining > 0) {
+        io_chunk_t *chunk = file->current;
+
+        // A seek ends the contiguous run of the current chunk
+        if (chunk && (chunk->offset + (int64_t)chunk->size != file->position ||
+                      chunk->size == STORAGE_IO_CHUNK_SIZE)) {
+            submit_current(file);
+            chunk = NULL;
+        }
+
+        if (!chunk) {
+            chunk = get_chunk(file->device);
+            if (!chunk) {
+                return AVERROR(ENOMEM);
+            }
+            chunk->offset = file->position;
+            chunk->created_ms = now_ms();
+            file->current = chunk;
+        }
+
+        size_t space = STORAGE_IO_CHUNK_SIZE - chunk->size;
+        size_t copy = (size_t)remaining < space ? (size_t)remaining : space;
+        memcpy(chunk->data + chunk->size, data, copy);
+        chunk->size += copy;
+        data += copy;
+        remaining -= (int)copy;
+
+        file->position += (int64_t)copy;
+        if (file->position > file->size) {
+            file->size = file->position;
+        }
+    }
+
+    if (file->current && (file->current->size == STORAGE_IO_CHUNK_SIZE ||
+                          now_ms() - file->current->created_ms >= max_delay_ms(file->device))) {
+        submit_current(file);
+    }
+
+    return size;
+}
+
+/**
+ * Move the position for the following writes
+ */
+int64_t storage_io_seek(storage_io_file_t *file, int64_t offset, int whence) {
+    if (!file) {
+        return AVERROR(EINVAL);
+    }
+
+    int64_t position;
+    switch (whence & ~AVSEEK_FORCE) {
+        case AVSEEK_SIZE:
+            return file->size;
+        case SEEK_SET:
+            position = offset;
+            break;
+        case SEEK_CUR:
+            position = file->position + offset;
+            break;
+        case SEEK_END:
+            position = file->size + offset;
+            break;
+        default:
+            return AVERROR(EINVAL);
+    }
+
+    if (position < 0) {
+        return AVERROR(EINVAL);
+    }
+
+    file->position = position;
+    return position;
+}
+
+/**
+ * Wait for the queued data of a file and close it
+ */
+int64_t storage_io_close(storage_io_file_t *file) {
+    if (!file) {
+        return AVERROR(EINVAL);
+    }
+
+    submit_current(file);
+
+    io_device_t *device = file->device;
+    pthread_mutex_lock(&device->mutex);
+    while (file->pending > 0) {
+        pthread_cond_wait(&device->done_cond, &device->mutex);
+    }
+    int error = file->error;
+    pthread_mutex_unlock(&device->mutex);
+
+    // Release the preallocated blocks past the data
+    if (file->preallocated && ftruncate(file->fd, (off_t)file->size) != 0) {
+        log_warn("Failed to trim %s: %s", file->path, strerror(errno));
+    }
+
+    // Starts writeback of what is left without waiting for it and drops the clean pages
+    posix_fadvise(file->fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(file->fd);
+
+    int64_t size = file->size;
+    free(file);
+    return error ? AVERROR(error) : size;
+}
+
+#if LIBAVFORMAT_VERSION_MAJOR >= 61
+static int avio_write_callback(void *opaque, const uint8_t *buf, int buf_size) {
+#else
+static int avio_write_callback(void *opaque, uint8_t *buf, int buf_size) {
+#endif
+    return storage_io_write((storage_io_file_t *)opaque, buf, buf_size);
+}
+
+static int64_t avio_seek_callback(void *opaque, int64_t offset, int whence) {
+    return storage_io_seek((storage_io_file_t *)opaque, offset, whence);
+}
+
+/**
+ * Create a file written through the I/O thread as an AVIOContext
+ */
+int storage_io_open_avio(AVIOContext **pb, const char *path, int64_t expected_size) {
+    if (!pb) {
+        return AVERROR(EINVAL);
+    }
+    *pb = NULL;
+
+    storage_io_file_t *file = storage_io_open(path, expected_size);
+    if (!file) {
+        return AVERROR(EIO);
+    }
+
+    uint8_t *buffer = av_malloc(STORAGE_IO_AVIO_BUFFER_SIZE);
+    if (!buffer) {
+        storage_io_close(file);
+        return AVERROR(ENOMEM);
+    }
+
+    *pb = avio_alloc_context(buffer, STORAGE_IO_AVIO_BUFFER_SIZE, 1, file, NULL,
+                             avio_write_callback, avio_seek_callback);
+    if (!*pb) {
+        av_free(buffer);
+        storage_io_close(file);
+        return AVERROR(ENOMEM);
+    }
+
+    return 0;
+}
+
+/**
+ * Check whether an AVIOContext was created by storage_io_open_avio
+ */
+int storage_io_is_avio(const AVIOContext *pb) {
+    return pb && pb->write_packet == avio_write_callback;
+}
+
+/**
+ * Rename the file behind a context created by storage_io_open_avio
+ */
+int storage_io_rename_avio(AVIOContext *pb, const char *path) {
+    if (!storage_io_is_avio(pb) || !path) {
+        return AVERROR(EINVAL);
+    }
+
+    storage_io_file_t *file = (storage_io_file_t *)pb->opaque;
+    io_device_t *device = file->device;
+
+    // The I/O thread logs failed writes with the path, under the device mutex
+    pthread_mutex_lock(&device->mutex);
+    int ret = 0;
+    if (rename(file->path, path) != 0) {
+        ret = AVERROR(errno);
+    } else {
+        strncpy(file->path, path, MAX_PATH_LENGTH - 1);
+        file->path[MAX_PATH_LENGTH - 1] = '\0';
+    }
+    pthread_mutex_unlock(&device->mutex);
+
+    return ret;
+}
+
+/**
+ * Flush, close and free a context created by storage_io_open_avio
+ */
+int64_t storage_io_close_avio(AVIOContext **pb) {
+    if (!pb || !*pb) {
+        return AVERROR(EINVAL);
+    }
+
+    avio_flush(*pb);
+    storage_io_file_t *file = (storage_io_file_t *)(*pb)->opaque;
+
+    av_freep(&(*pb)->buffer);
+    avio_context_free(pb);
+
+    return storage_io_close(file);
+}
+
+/**
+ * Stop the I/O threads once their queues are written
+ */
+void storage_io_shutdown(void) {
+    pthread_mutex_lock(&devices_mutex);
+
+    for (int i = 0; i < STORAGE_IO_MAX_DEVICES; i++) {
+        io_device_t *device = &devices[i];
+        if (!device->used) {
+            continue;
+        }
+
+        pthread_mutex_lock(&device->mutex);
+        device->running = false;
+        pthread_cond_broadcast(&device->work_cond);
+        pthread_cond_broadcast(&device->done_cond);
+        pthread_mutex_unlock(&device->mutex);
+
+        pthread_join(device->thread, NULL);
+
+        while (device->free_chunks) {
+            io_chunk_t *chunk = device->free_chunks;
+            device->free_chunks = chunk->next;
+            free(chunk->data);
+            free(chunk);
+        }
+#ifdef HAVE_LIBURING
+        teardown_ring(device);
+#endif
+
+        pthread_mutex_destroy(&device->mutex);
+        pthread_cond_destroy(&device->work_cond);
+        pthread_cond_destroy(&device->done_cond);
+        device->used = false;
+    }
+
+    pthread_mutex_unlock(&devices_mutex);
+}
@@ -0,0 +1,390 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+
+#include "core/logger.h"
+#include "core/config.h"
+#include "core/metrics.h"
+#include "database/db_events.h"
+#include "storage/storage_latency.h"
+#include "video/thread_utils.h"
+
+// Seconds between ratings
+#define STORAGE_LATENCY_SAMPLE_SECONDS 2
+
+// Seconds of samples the percentiles are taken over
+#define STORAGE_LATENCY_WINDOW_SECONDS 30
+
+// Samples kept per disk and kind of operation
+#define STORAGE_LATENCY_SAMPLES 512
+
+// Samples a window needs before its percentiles count
+#define STORAGE_LATENCY_MIN_SAMPLES 5
+
+// Consecutive better ratings before a disk is rated one step better
+#define STORAGE_LATENCY_RELAX_SAMPLES 5
+
+typedef struct {
+    uint64_t time_us;           // When the operation finished
+    uint32_t latency_us;
+} latency_sample_t;
+
+typedef struct {
+    dev_t device;
+    char label[32];             // major:minor, the device label of the metrics
+    pthread_mutex_t mutex;      // Guards the samples and waits
+    latency_sample_t samples[STORAGE_OP_COUNT][STORAGE_LATENCY_SAMPLES];
+    int next[STORAGE_OP_COUNT];
+    int count[STORAGE_OP_COUNT];
+    int writer_waits;           // Since the last rating
+    atomic_uint_fast64_t busy_since_us;     // Start of the operation in progress, 0 if none
+    atomic_int level;
+    int relax_samples;          // Monitor thread only
+    metric_t histograms[STORAGE_OP_COUNT];
+    metric_t p50[STORAGE_OP_COUNT];
+    metric_t p99[STORAGE_OP_COUNT];
+    metric_t level_gauge;
+    metric_t waits_counter;
+} device_latency_t;
+
+static device_latency_t devices[STORAGE_LATENCY_MAX_DEVICES];
+static atomic_int device_count = 0;
+static pthread_mutex_t devices_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_t monitor_thread;
+static bool monitor_running = false;
+static pthread_mutex_t monitor_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t monitor_cond = PTHREAD_COND_INITIALIZER;     // Signaled to stop the thread
+
+static const char *const op_names[STORAGE_OP_COUNT] = {
+    [STORAGE_OP_WRITE] = "write",
+    [STORAGE_OP_SYNC] = "sync"
+};
+
+const char *storage_latency_level_name(storage_latency_level_t level) {
+    switch (level) {
+        case STORAGE_LATENCY_OK:
+            return "ok";
+        case STORAGE_LATENCY_SLOW:
+            return "slow";
+        case STORAGE_LATENCY_CRITICAL:
+            return "critical";
+    }
+    return "unknown";
+}
+
+static int compare_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+int storage_latency_register(dev_t device) {
+    pthread_mutex_lock(&devices_mutex);
+
+    int count = atomic_load(&device_count);
+    for (int i = 0; i < count; i++) {
+        if (devices[i].device == device) {
+            pthread_mutex_unlock(&devices_mutex);
+            return i;
+        }
+    }
+    if (count == STORAGE_LATENCY_MAX_DEVICES) {
+        pthread_mutex_unlock(&devices_mutex);
+        return -1;
+    }
+
+    device_latency_t *d = &devices[count];
+    memset(d, 0, sizeof(*d));
+    d->device = device;
+    snprintf(d->label, sizeof(d->label), "%u:%u", major(device), minor(device));
+    pthread_mutex_init(&d->mutex, NULL);
+
+    d->histograms[STORAGE_OP_WRITE] = metrics_histogram("lightnvr_storage_write_seconds",
+                                                        "Time the storage I/O thread took for a write",
+                                                        "device", d->label, NULL);
+    d->histograms[STORAGE_OP_SYNC] = metrics_histogram("lightnvr_storage_sync_seconds",
+                                                       "Time the storage I/O thread took for a data sync",
+                                                       "device", d->label, NULL);
+    for (int op = 0; op < STORAGE_OP_COUNT; op++) {
+        d->p50[op] = metrics_gauge("lightnvr_storage_latency_microseconds",
+                                   "Storage latency percentile over the last 30 seconds",
+                                   "device", d->label, "op", op_names[op], "quantile", "0.5", NULL);
+        d->p99[op] = metrics_gauge("lightnvr_storage_latency_microseconds",
+                                   "Storage latency percentile over the last 30 seconds",
+                                   "device", d->label, "op", op_names[op], "quantile", "0.99", NULL);
+    }
+    d->level_gauge = metrics_gauge("lightnvr_storage_latency_level",
+                                   "Rating of a disk: 0 ok, 1 slow, 2 critical",
+                                   "device", d->label, NULL);
+    d->waits_counter = metrics_counter("lightnvr_storage_writer_waits_total",
+                                       "Times a recorder waited for the full write queue of a disk",
+                                       "device", d->label, NULL);
+
+    // Published last, so readers only see slots that are set up
+    atomic_store(&device_count, count + 1);
+    pthread_mutex_unlock(&devices_mutex);
+    return count;
+}
+
+uint64_t storage_latency_begin(int slot) {
+    uint64_t now = metrics_now_us();
+    if (slot >= 0 && slot < STORAGE_LATENCY_MAX_DEVICES) {
+        atomic_store(&devices[slot].busy_since_us, now);
+    }
+    return now;
+}
+
+void storage_latency_end(int slot, storage_op_t op, uint64_t start_us) {
+    if (slot < 0 || slot >= STORAGE_LATENCY_MAX_DEVICES || op < 0 || op >= STORAGE_OP_COUNT) {
+        return;
+    }
+
+    device_latency_t *d = &devices[slot];
+    uint64_t now = metrics_now_us();
+    uint64_t latency = now > start_us ? now - start_us : 0;
+    atomic_store(&d->busy_since_us, 0);
+    metrics_observe_us(d->histograms[op], latency);
+
+    pthread_mutex_lock(&d->mutex);
+    latency_sample_t *sample = &d->samples[op][d->next[op]];
+    sample->time_us = now;
+    sample->latency_us = latency > UINT32_MAX ? UINT32_MAX : (uint32_t)latency;
+    d->next[op] = (d->next[op] + 1) % STORAGE_LATENCY_SAMPLES;
+    if (d->count[op] < STORAGE_LATENCY_SAMPLES) {
+        d->count[op]++;
+    }
+    pthread_mutex_unlock(&d->mutex);
+}
+
+void storage_latency_writer_waited(int slot) {
+    if (slot < 0 || slot >= STORAGE_LATENCY_MAX_DEVICES) {
+        return;
+    }
+
+    device_latency_t *d = &devices[slot];
+    metrics_add(d->waits_counter, 1);
+    pthread_mutex_lock(&d->mutex);
+    d->writer_waits++;
+    pthread_mutex_unlock(&d->mutex);
+}
+
+storage_latency_level_t storage_latency_level(int slot) {
+    if (slot < 0 || slot >= atomic_load(&device_count)) {
+        return STORAGE_LATENCY_OK;
+    }
+    return (storage_latency_level_t)atomic_load(&devices[slot].level);
+}
+
+storage_latency_level_t storage_latency_level_of_path(const char *path) {
+    struct stat st;
+    if (!path || stat(path, &st) != 0) {
+        return STORAGE_LATENCY_OK;
+    }
+
+    int count = atomic_load(&device_count);
+    for (int i = 0; i < count; i++) {
+        if (devices[i].device == st.st_dev) {
+            return (storage_latency_level_t)atomic_load(&devices[i].level);
+        }
+    }
+    return STORAGE_LATENCY_OK;
+}
+
+storage_latency_level_t storage_latency_worst_level(void) {
+    storage_latency_level_t worst = STORAGE_LATENCY_OK;
+    int count = atomic_load(&device_count);
+    for (int i = 0; i < count; i++) {
+        storage_latency_level_t level = (storage_latency_level_t)atomic_load(&devices[i].level);
+        if (level > worst) {
+            worst = level;
+        }
+    }
+    return worst;
+}
+
+/**
+ * Take the p50 and p99 of the samples of the window
+ *
+ * @return Number of samples in the window
+ */
+static int window_percentiles(device_latency_t *d, storage_op_t op, uint64_t since_us,
+                              uint32_t *p50, uint32_t *p99) {
+    uint32_t values[STORAGE_LATENCY_SAMPLES];
+    int n = 0;
+
+    pthread_mutex_lock(&d->mutex);
+    for (int i = 0; i < d->count[op]; i++) {
+        if (d->samples[op][i].time_us >= since_us) {
+            values[n++] = d->samples[op][i].latency_us;
+        }
+    }
+    pthread_mutex_unlock(&d->mutex);
+
+    *p50 = 0;
+    *p99 = 0;
+    if (n == 0) {
+        return 0;
+    }
+    qsort(values, (size_t)n, sizeof(values[0]), compare_u32);
+    *p50 = values[n / 2];
+    *p99 = values[(n * 99) / 100 < n ? (n * 99) / 100 : n - 1];
+    return n;
+}
+
+/**
+ * Rate one disk from its last window
+ */
+static void rate_device(device_latency_t *d, uint64_t now_us) {
+    uint64_t since_us = now_us > (uint64_t)STORAGE_LATENCY_WINDOW_SECONDS * 1000000 ?
+                        now_us - (uint64_t)STORAGE_LATENCY_WINDOW_SECONDS * 1000000 : 0;
+
+    uint32_t worst_p99 = 0;
+    const char *worst_op = op_names[STORAGE_OP_WRITE];
+    for (int op = 0; op < STORAGE_OP_COUNT; op++) {
+        uint32_t p50, p99;
+        int n = window_percentiles(d, op, since_us, &p50, &p99);
+        metrics_set(d->p50[op], p50);
+        metrics_set(d->p99[op], p99);
+        if (n >= STORAGE_LATENCY_MIN_SAMPLES && p99 > worst_p99) {
+            worst_p99 = p99;
+            worst_op = op_names[op];
+        }
+    }
+
+    // A write that has not come back counts with the time it has taken so far
+    uint64_t busy_since = atomic_load(&d->busy_since_us);
+    if (busy_since > 0 && now_us > busy_since && now_us - busy_since > worst_p99) {
+        uint64_t stuck = now_us - busy_since;
+        worst_p99 = stuck > UINT32_MAX ? UINT32_MAX : (uint32_t)stuck;
+        worst_op = "stuck write";
+    }
+
+    pthread_mutex_lock(&d->mutex);
+    int writer_waits = d->writer_waits;
+    d->writer_waits = 0;
+    pthread_mutex_unlock(&d->mutex);
+
+    uint64_t slow_us = (uint64_t)g_config.storage_latency_slow_ms * 1000;
+    uint64_t critical_us = (uint64_t)g_config.storage_latency_critical_ms * 1000;
+    storage_latency_level_t target = STORAGE_LATENCY_OK;
+    if (writer_waits > 0 || (critical_us > 0 && worst_p99 >= critical_us)) {
+        target = STORAGE_LATENCY_CRITICAL;
+    } else if (worst_p99 >= slow_us) {
+        target = STORAGE_LATENCY_SLOW;
+    }
+
+    storage_latency_level_t level = (storage_latency_level_t)atomic_load(&d->level);
+    if (target > level) {
+        d->relax_samples = 0;
+        atomic_store(&d->level, target);
+
+        char details[256];
+        snprintf(details, sizeof(details),
+                 "Disk %s rated %s: %s p99 %u ms, %d recorder waits in the last %d seconds",
+                 d->label, storage_latency_level_name(target), worst_op, worst_p99 / 1000,
+                 writer_waits, STORAGE_LATENCY_SAMPLE_SECONDS);
+        if (target == STORAGE_LATENCY_CRITICAL) {
+            log_error("%s; live HLS kept in memory, footage may be lost if it does not recover", details);
+        } else {
+            log_warn("%s; writing in larger batches and deferring thumbnails, compaction and archiving",
+                     details);
+        }
+        add_event(EVENT_STORAGE_SLOW, NULL, "Storage latency high", details);
+    } else if (target < level) {
+        if (++d->relax_samples >= STORAGE_LATENCY_RELAX_SAMPLES) {
+            d->relax_samples = 0;
+            atomic_store(&d->level, level - 1);
+            log_info("Disk %s rated %s again: %s p99 %u ms",
+                     d->label, storage_latency_level_name(level - 1), worst_op, worst_p99 / 1000);
+        }
+    } else {
+        d->relax_samples = 0;
+    }
+
+    metrics_set(d->level_gauge, (uint64_t)atomic_load(&d->level));
+}
+
+static void *storage_latency_func(void *arg) {
+    (void)arg;
+    thread_set_identity(THREAD_CLASS_SERVICE, "storage-latency", NULL);
+
+    pthread_mutex_lock(&monitor_mutex);
+    while (monitor_running) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += STORAGE_LATENCY_SAMPLE_SECONDS;
+        pthread_cond_timedwait(&monitor_cond, &monitor_mutex, &deadline);
+        if (!monitor_running) {
+            break;
+        }
+        pthread_mutex_unlock(&monitor_mutex);
+
+        uint64_t now_us = metrics_now_us();
+        int count = atomic_load(&device_count);
+        for (int i = 0; i < count; i++) {
+            rate_device(&devices[i], now_us);
+        }
+
+        pthread_mutex_lock(&monitor_mutex);
+    }
+    pthread_mutex_unlock(&monitor_mutex);
+
+    return NULL;
+}
+
+int storage_latency_init(void) {
+    if (g_config.storage_latency_slow_ms <= 0) {
+        log_info("Storage latency monitor disabled");
+        return 0;
+    }
+
+    pthread_mutex_lock(&monitor_mutex);
+    if (monitor_running) {
+        pthread_mutex_unlock(&monitor_mutex);
+        return 0;
+    }
+
+    monitor_running = true;
+    if (pthread_create(&monitor_thread, NULL, storage_latency_func, NULL) != 0) {
+        log_error("Failed to start storage latency monitor thread");
+        monitor_running = false;
+        pthread_mutex_unlock(&monitor_mutex);
+        return -1;
+    }
+    pthread_mutex_unlock(&monitor_mutex);
+
+    log_info("Storage latency monitor started (slow at %d ms, critical at %d ms)",
+             g_config.storage_latency_slow_ms, g_config.storage_latency_critical_ms);
+    return 0;
+}
+
+void storage_latency_shutdown(void) {
+    pthread_mutex_lock(&monitor_mutex);
+    if (!monitor_running) {
+        pthread_mutex_unlock(&monitor_mutex);
+        return;
+    }
+    monitor_running = false;
+    pthread_cond_signal(&monitor_cond);
+    pthread_mutex_unlock(&monitor_mutex);
+
+    pthread_join(monitor_thread, NULL);
+
+    int count = atomic_load(&device_count);
+    for (int i = 0; i < count; i++) {
+        atomic_store(&devices[i].level, STORAGE_LATENCY_OK);
+        metrics_set(devices[i].level_gauge, STORAGE_LATENCY_OK);
+    }
+
+    log_info("Storage latency monitor stopped");
+}
@@ -12,7 +12,21 @@
 
 #include "storage/storage_manager.h"
 #include "storage/storage_manager_streams_cache.h"
+#include "storage/retention_engine.h"
+#include "storage/deletion_worker.h"
+#include "storage/archive_worker.h"
+#include "storage/upload_worker.h"
+#include "storage/compaction_worker.h"
+#include "storage/recording_layout.h"
 #include "core/logger.h"
+#include "database/db_core.h"
+#include "database/db_recordings.h"
+#include "database/db_detections.h"
+#include "database/db_events.h"
+#include "database/db_recording_usage.h"
+#include "database/db_streams.h"
+#include "video/recording_thumbnails.h"
+#include "video/thread_utils.h"
 
 // Storage manager state
 static struct {
@@ -66,11 +80,43 @@ int init_storage_manager(const char *storage_path, uint64_t max_size) {
         log_warn("Failed to start storage manager thread, automatic tasks will not be performed");
     }
 
+    // Unlinks the files of deleted recordings, starting with those left from the last run
+    if (start_deletion_worker() != 0) {
+        log_warn("Failed to start deletion worker, deleted recordings will keep their files until restart");
+    }
+
+    // Frees space oldest first across streams when the disk fills
+    if (start_retention_engine(storage_path) != 0) {
+        log_warn("Failed to start retention engine, recordings will not be deleted when the disk fills");
+    }
+
+    // Moves aged recordings to [storage] archive_path, if one is set
+    if (start_archive_worker() != 0) {
+        log_warn("Failed to start archive worker, recordings will stay on local storage");
+    }
+
+    // Uploads event clips to [upload] url, if one is set
+    if (start_upload_worker() != 0) {
+        log_warn("Failed to start upload worker, event clips will not be uploaded");
+    }
+
+    // Compacts short clips and thins aged recordings, if [storage] compact_clip_seconds
+    // or thin_after_days is set
+    if (start_compaction_worker() != 0) {
+        log_warn("Failed to start compaction worker, recordings will be kept as they are");
+    }
+
     return 0;
 }
 
 // Shutdown the storage manager
 void shutdown_storage_manager(void) {
+    stop_compaction_worker();
+    stop_upload_worker();
+    stop_archive_worker();
+    stop_retention_engine();
+    stop_deletion_worker();
+
     // Stop the storage manager thread
     if (stop_storage_manager_thread() != 0) {
         log_warn("Failed to stop storage manager thread");
@@ -122,7 +168,17 @@ int get_storage_stats(storage_stats_t *stats) {
     stats->used_space = stats->total_space - stats->free_space;
     stats->reserved_space = storage_manager.reserved_space;
 
-    // Scan the storage directory to get recording statistics
+    // The recording totals are kept up to date as recordings come and go
+    recording_usage_t totals;
+    if (get_recording_usage_totals(&totals) == 0) {
+        stats->total_recordings = totals.recording_count;
+        stats->total_recording_bytes = totals.size_bytes;
+        stats->oldest_recording_time = totals.oldest_time;
+        stats->newest_recording_time = totals.newest_time;
+        return 0;
+    }
+
+    // Without the database, scan the storage directory to get recording statistics
     DIR *dir = opendir(storage_manager.storage_path);
     if (dir) {
         struct dirent *entry;
@@ -218,12 +274,48 @@ int delete_recording(const char *path) {
         log_error("Failed to delete file: %s (error: %s)", path, strerror(errno));
         return -1;
     }
+    recording_thumbnails_remove(path);
+    recording_layout_prune(path);
 
     log_info("Successfully deleted recording file: %s", path);
     return 0;
 }
 
 // Apply retention policy
+/**
+ * Get the retention days of a stream directory
+ * Streams with their own retention_days keep their recordings for that
+ * long; any other directory uses the global setting.
+ */
+static int directory_retention_days(const char *name) {
+    stream_config_t stream;
+    if (get_db_handle() && get_stream_config_by_name(name, &stream) == 0 && stream.retention_days > 0) {
+        return stream.retention_days;
+    }
+    return storage_manager.retention_days;
+}
+
+/**
+ * Check the usage totals for a stream whose oldest recording has expired
+ *
+ * @return 1 if one has, 0 if none has, -1 if the totals are not known
+ */
+static int recordings_expired(time_t now) {
+    recording_usage_t usage[MAX_USAGE_STREAMS];
+    int count = get_recording_usage(usage, MAX_USAGE_STREAMS);
+    if (count <= 0) {
+        return -1;
+    }
+
+    for (int i = 0; i < count; i++) {
+        int days = directory_retention_days(usage[i].stream_name);
+        if (days > 0 && usage[i].oldest_time > 0 && usage[i].oldest_time < now - (time_t)days * 86400) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
 int apply_retention_policy(void) {
     log_info("Applying retention policy (max size: %lu bytes, retention days: %d)",
              storage_manager.max_size, storage_manager.retention_days);
@@ -248,6 +340,19 @@ int apply_retention_policy(void) {
     time_t now = time(NULL);
     time_t cutoff_time = now - (storage_manager.retention_days * 86400); // 86400 seconds in a day
 
+    // The totals tell whether any recording can have expired, so most passes
+    // skip the walk; one a day still runs for files the database does not know
+    static time_t last_full_walk = 0;
+    int expired = recordings_expired(now);
+    if (expired < 0 && stats.oldest_recording_time > 0) {
+        expired = (time_t)stats.oldest_recording_time < cutoff_time;
+    }
+    if (!need_cleanup_size && expired == 0 && now - last_full_walk < 86400) {
+        log_debug("Oldest recording is within the retention period, nothing to delete");
+        return 0;
+    }
+    last_full_walk = now;
+
     // Track deleted files
     int deleted_count = 0;
     uint64_t freed_space = 0;
@@ -283,6 +388,9 @@ int apply_retention_policy(void) {
 
         struct stat st;
         if (stat(stream_path, &st) == 0 && S_ISDIR(st.st_mode)) {
+            int stream_days = directory_retention_days(entry->d_name);
+            time_t stream_cutoff = now - (time_t)stream_days * 86400;
+
             // Scan stream directory for recordings
             DIR *stream_dir = opendir(stream_path);
             if (stream_dir) {
@@ -301,7 +409,7 @@ int apply_retention_policy(void) {
                     struct stat rec_st;
                     if (stat(rec_path, &rec_st) == 0 && S_ISREG(rec_st.st_mode)) {
                         // Check if file is older than retention days
-                        if (need_cleanup_days && rec_st.st_mtime < cutoff_time) {
+                        if (need_cleanup_days && stream_days > 0 && rec_st.st_mtime < stream_cutoff) {
                             // Delete file directly if it's older than retention days
                             if (unlink(rec_path) == 0) {
                                 log_debug("Deleted old recording: %s (age: %ld days)",
@@ -409,8 +517,22 @@ bool is_storage_available(void) {
 
 // Get path to a recording file
 int get_recording_path(const char *stream_name, time_t timestamp, char *path, size_t path_size) {
-    // Stub implementation
-    return 0;
+    if (!stream_name || !path || path_size == 0) {
+        return -1;
+    }
+
+    char dir[MAX_PATH_LENGTH];
+    if (recording_layout_dir(stream_name, timestamp, dir, sizeof(dir)) != 0) {
+        return -1;
+    }
+
+    char timestamp_str[32];
+    struct tm tm;
+    localtime_r(&timestamp, &tm);
+    strftime(timestamp_str, sizeof(timestamp_str), "%Y%m%d_%H%M%S", &tm);
+
+    int n = snprintf(path, path_size, "%s/recording_%s.mp4", dir, timestamp_str);
+    return (n > 0 && (size_t)n < path_size) ? 0 : -1;
 }
 
 // Create a directory for a stream if it doesn't exist
@@ -438,8 +560,20 @@ int create_stream_directory(const char *stream_name) {
 
 // Check disk space and ensure minimum free space is available
 bool ensure_disk_space(uint64_t min_free_bytes) {
-    // Stub implementation
-    return true;
+    struct statvfs fs_stats;
+    if (statvfs(storage_manager.storage_path, &fs_stats) != 0) {
+        log_error("Failed to get filesystem statistics: %s", strerror(errno));
+        return false;
+    }
+
+    uint64_t free_bytes = (uint64_t)fs_stats.f_bavail * fs_stats.f_frsize;
+    if (free_bytes >= min_free_bytes) {
+        return true;
+    }
+
+    // The retention engine frees space in the background
+    request_retention_pass();
+    return false;
 }
 
 // Storage manager thread state
@@ -460,14 +594,56 @@ static struct {
 // Forward declaration for the cache refresh function
 extern int force_refresh_cache(void);
 
+// Seconds between rebuilds of the recording usage totals from the database
+#define USAGE_RECONCILE_INTERVAL (6 * 3600)
+
+// Free pages returned to the file system per storage manager pass
+#define RETENTION_VACUUM_PAGES 4096
+
+/**
+ * Apply the retention days to the database
+ * Deletes run in small batches with pauses in between, so the rows of a
+ * long outage or a shortened retention go without stalling the database.
+ */
+static void apply_database_retention(void) {
+    if (storage_manager.retention_days <= 0) {
+        return;
+    }
+
+    uint64_t max_age = (uint64_t)storage_manager.retention_days * 86400;
+
+    // Archived files are beyond the directory walk, so they go with their metadata
+    int archived = expire_archived_recordings(max_age);
+    if (archived > 0) {
+        log_info("Deleted %d archived recordings past the retention period", archived);
+    }
+
+    int recordings = delete_old_recording_metadata(max_age);
+    int detections = delete_old_detections(max_age);
+    int events = delete_old_events(max_age);
+    if (recordings > 0 || detections > 0 || events > 0) {
+        log_info("Database retention deleted %d recordings, %d detections and %d events",
+                 recordings > 0 ? recordings : 0, detections > 0 ? detections : 0, events > 0 ? events : 0);
+    }
+
+    incremental_vacuum_database(RETENTION_VACUUM_PAGES);
+}
+
 // Storage manager thread function
 static void* storage_manager_thread_func(void *arg) {
+    thread_set_identity(THREAD_CLASS_SERVICE, "storage", NULL);
     log_info("Storage manager thread started with interval: %d seconds", storage_manager_thread.interval_seconds);
     log_info("Cache refresh interval: %d seconds", storage_manager_thread.cache_refresh_interval);
 
     // Initialize last cache refresh time
     storage_manager_thread.last_cache_refresh = time(NULL);
 
+    // Seed the recording usage totals, which the cache and retention read
+    time_t last_usage_reconcile = 0;
+    if (get_db_handle() && reconcile_recording_usage() >= 0) {
+        last_usage_reconcile = time(NULL);
+    }
+
     // Initial cache refresh
     if (force_refresh_cache() == 0) {
         log_info("Initial cache refresh successful");
@@ -486,6 +662,16 @@ static void* storage_manager_thread_func(void *arg) {
             log_error("Storage manager thread encountered an error applying retention policy");
         }
 
+        if (get_db_handle()) {
+            apply_database_retention();
+
+            // Corrects any drift of the incrementally kept totals
+            if (now - last_usage_reconcile >= USAGE_RECONCILE_INTERVAL &&
+                reconcile_recording_usage() >= 0) {
+                last_usage_reconcile = now;
+            }
+        }
+
         // Check if it's time to refresh the cache
         if (now - storage_manager_thread.last_cache_refresh >= storage_manager_thread.cache_refresh_interval) {
             log_info("Refreshing storage cache");
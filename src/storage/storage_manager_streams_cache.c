@@ -16,6 +16,8 @@
 #include "storage/storage_manager.h"
 #include "core/logger.h"
 #include "core/config.h"
+#include "core/device_profile.h"
+#include "database/db_recording_usage.h"
 #include "../../external/cjson/cJSON.h"
 
 // Forward declarations for functions from storage_manager_streams.c
@@ -88,6 +90,34 @@ static int is_cache_stale(void) {
     return 0;
 }
 
+/**
+ * Get stream storage usage from the recording usage totals
+ * Costs one entry per stream instead of a walk over every file.
+ *
+ * @param stream_info Pointer to array that will be allocated and filled
+ * @return Number of streams, or -1 if the totals are not available
+ */
+static int get_usage_from_totals(stream_storage_info_t **stream_info) {
+    recording_usage_t usage[MAX_USAGE_STREAMS];
+    int count = get_recording_usage(usage, MAX_USAGE_STREAMS);
+    if (count <= 0) {
+        return -1;
+    }
+
+    *stream_info = (stream_storage_info_t *)calloc(count, sizeof(stream_storage_info_t));
+    if (!*stream_info) {
+        log_error("Failed to allocate memory for stream storage info");
+        return -1;
+    }
+
+    for (int i = 0; i < count; i++) {
+        strncpy((*stream_info)[i].name, usage[i].stream_name, sizeof((*stream_info)[i].name) - 1);
+        (*stream_info)[i].size_bytes = (unsigned long)usage[i].size_bytes;
+        (*stream_info)[i].recording_count = usage[i].recording_count;
+    }
+    return count;
+}
+
 /**
  * Refresh the cache with current storage usage data
  *
@@ -95,12 +125,16 @@ static int is_cache_stale(void) {
  */
 static int refresh_cache(void) {
     if (!cache.initialized) {
-        init_storage_manager_streams_cache(900);
+        init_storage_manager_streams_cache(device_profile_value(DEVICE_KNOB_STORAGE_CACHE_TTL));
     }
 
-    // Get current stream storage usage
+    // Get current stream storage usage, walking the directories only
+    // when the database has none
     stream_storage_info_t *stream_info = NULL;
-    int stream_count = get_all_stream_storage_usage(&stream_info);
+    int stream_count = get_usage_from_totals(&stream_info);
+    if (stream_count <= 0) {
+        stream_count = get_all_stream_storage_usage(&stream_info);
+    }
 
     if (stream_count <= 0 || !stream_info) {
         log_warn("No stream storage usage information available for cache refresh");
@@ -197,8 +231,8 @@ int add_cached_stream_storage_usage_to_json(cJSON *json_obj, int force_refresh)
 
     // Check if cache is initialized
     if (!cache.initialized) {
-        log_warn("Storage manager streams cache not initialized, initializing with default TTL");
-        if (init_storage_manager_streams_cache(300) != 0) {
+        log_warn("Storage manager streams cache not initialized, initializing with the device profile's TTL");
+        if (init_storage_manager_streams_cache(device_profile_value(DEVICE_KNOB_STORAGE_CACHE_TTL)) != 0) {
             log_error("Failed to initialize storage manager streams cache");
             // Still add the empty array to the JSON object
             cJSON_AddItemToObject(json_obj, "streamStorage", stream_storage_array);
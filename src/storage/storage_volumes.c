@@ -0,0 +1,325 @@
+/**
+ * Recording Volumes
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+
+#include "core/config.h"
+#include "core/logger.h"
+#include "storage/storage_volumes.h"
+
+// Seconds a volume that failed is passed over
+#define VOLUME_RETRY_INTERVAL 60
+
+typedef enum {
+    PLACEMENT_ROUND_ROBIN,
+    PLACEMENT_FREE_SPACE,
+    PLACEMENT_PINNED
+} placement_t;
+
+typedef struct {
+    char path[MAX_PATH_LENGTH];
+    time_t down_until;          // Passed over until then after a failure
+} volume_t;
+
+// Volume a stream was placed on, for round_robin and pinned placement
+typedef struct {
+    char stream_name[MAX_STREAM_NAME];
+    int volume;
+} assignment_t;
+
+static volume_t volumes[STORAGE_MAX_VOLUMES];
+static int volume_count = 0;
+static placement_t placement = PLACEMENT_ROUND_ROBIN;
+
+static assignment_t assignments[MAX_STREAMS];
+static int assignment_count = 0;
+static int next_volume = 0;
+
+static pthread_mutex_t volumes_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t volumes_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Copy a path without trailing slashes
+ */
+static void set_volume_path(volume_t *volume, const char *path, size_t len) {
+    while (len > 1 && path[len - 1] == '/') {
+        len--;
+    }
+    if (len >= sizeof(volume->path)) {
+        len = sizeof(volume->path) - 1;
+    }
+    memcpy(volume->path, path, len);
+    volume->path[len] = '\0';
+}
+
+/**
+ * Read the volumes from the configuration
+ * Changes to them take effect after a restart.
+ */
+static void load_volumes(void) {
+    if (g_config.record_mp4_directly && g_config.mp4_storage_path[0] != '\0') {
+        set_volume_path(&volumes[0], g_config.mp4_storage_path, strlen(g_config.mp4_storage_path));
+    } else {
+        char path[MAX_PATH_LENGTH];
+        snprintf(path, sizeof(path), "%s/mp4", g_config.storage_path);
+        set_volume_path(&volumes[0], path, strlen(path));
+    }
+    volume_count = 1;
+
+    const char *p = g_config.storage_volumes;
+    while (*p) {
+        while (*p == ',' || *p == ' ') {
+            p++;
+        }
+        const char *end = p;
+        while (*end && *end != ',') {
+            end++;
+        }
+        size_t len = (size_t)(end - p);
+        while (len > 0 && p[len - 1] == ' ') {
+            len--;
+        }
+        if (len > 0) {
+            if (volume_count < STORAGE_MAX_VOLUMES) {
+                set_volume_path(&volumes[volume_count++], p, len);
+            } else {
+                log_warn("Only %d recording volumes are supported, ignoring the rest", STORAGE_MAX_VOLUMES);
+                break;
+            }
+        }
+        p = end;
+    }
+
+    if (strcmp(g_config.volume_placement, "free_space") == 0) {
+        placement = PLACEMENT_FREE_SPACE;
+    } else if (strcmp(g_config.volume_placement, "pinned") == 0) {
+        placement = PLACEMENT_PINNED;
+    } else {
+        placement = PLACEMENT_ROUND_ROBIN;
+    }
+
+    if (volume_count > 1) {
+        for (int i = 0; i < volume_count; i++) {
+            log_info("Recording volume %d: %s", i, volumes[i].path);
+        }
+        log_info("Streams are placed on %d recording volumes by %s", volume_count, g_config.volume_placement);
+    }
+}
+
+static void ensure_loaded(void) {
+    pthread_once(&volumes_once, load_volumes);
+}
+
+/**
+ * Check whether new recordings can go on a volume
+ * Further volumes are not created, so a missing mount is not mistaken for
+ * an empty disk and filled on the root file system. Called with
+ * volumes_mutex held.
+ */
+static bool volume_usable(int volume, uint64_t *free_bytes) {
+    volume_t *v = &volumes[volume];
+    time_t now = time(NULL);
+    if (v->down_until > now) {
+        return false;
+    }
+
+    if (volume == 0) {
+        // Created along with the stream directories, as always
+        mkdir(v->path, 0755);
+    }
+
+    struct statvfs fs;
+    if (statvfs(v->path, &fs) != 0 || access(v->path, W_OK) != 0) {
+        log_warn("Recording volume %s is not writable (%s), passing it over for %d seconds",
+                 v->path, strerror(errno), VOLUME_RETRY_INTERVAL);
+        v->down_until = now + VOLUME_RETRY_INTERVAL;
+        return false;
+    }
+    if (free_bytes) {
+        *free_bytes = (uint64_t)fs.f_bavail * fs.f_frsize;
+    }
+    return true;
+}
+
+/**
+ * Get the volume volume_pins gives a stream
+ *
+ * @return Index of the volume, or -1 if the stream is not pinned
+ */
+static int pinned_volume(const char *stream_name) {
+    size_t name_len = strlen(stream_name);
+    const char *p = g_config.volume_pins;
+    while (*p) {
+        while (*p == ',' || *p == ' ') {
+            p++;
+        }
+        const char *eq = strchr(p, '=');
+        if (!eq) {
+            break;
+        }
+        if ((size_t)(eq - p) == name_len && strncmp(p, stream_name, name_len) == 0) {
+            int volume = atoi(eq + 1);
+            return (volume >= 0 && volume < volume_count) ? volume : -1;
+        }
+        const char *next = strchr(eq, ',');
+        if (!next) {
+            break;
+        }
+        p = next;
+    }
+    return -1;
+}
+
+/**
+ * Spread streams that are not pinned by a hash of their name
+ */
+static int hashed_volume(const char *stream_name) {
+    uint32_t hash = 2166136261u;
+    for (const char *p = stream_name; *p; p++) {
+        hash = (hash ^ (uint8_t)*p) * 16777619u;
+    }
+    return (int)(hash % (uint32_t)volume_count);
+}
+
+/**
+ * Get the usable volume with the most free space
+ *
+ * @return Index of the volume, or -1 if none is usable
+ */
+static int emptiest_volume(void) {
+    int best = -1;
+    uint64_t best_free = 0;
+    for (int i = 0; i < volume_count; i++) {
+        uint64_t free_bytes;
+        if (volume_usable(i, &free_bytes) && (best < 0 || free_bytes > best_free)) {
+            best = i;
+            best_free = free_bytes;
+        }
+    }
+    return best;
+}
+
+/**
+ * Choose the volume of a stream's next recording
+ * Called with volumes_mutex held.
+ */
+static int choose_volume(const char *stream_name) {
+    if (volume_count == 1) {
+        return 0;
+    }
+
+    if (placement == PLACEMENT_FREE_SPACE) {
+        int volume = emptiest_volume();
+        return volume >= 0 ? volume : 0;
+    }
+
+    assignment_t *assignment = NULL;
+    for (int i = 0; i < assignment_count; i++) {
+        if (strcmp(assignments[i].stream_name, stream_name) == 0) {
+            assignment = &assignments[i];
+            break;
+        }
+    }
+
+    int preferred;
+    if (assignment) {
+        preferred = assignment->volume;
+    } else if (placement == PLACEMENT_PINNED) {
+        preferred = pinned_volume(stream_name);
+        if (preferred < 0) {
+            preferred = hashed_volume(stream_name);
+        }
+    } else {
+        preferred = next_volume;
+        next_volume = (next_volume + 1) % volume_count;
+    }
+
+    if (!assignment && assignment_count < MAX_STREAMS) {
+        assignment = &assignments[assignment_count++];
+        snprintf(assignment->stream_name, sizeof(assignment->stream_name), "%s", stream_name);
+        assignment->volume = preferred;
+    }
+
+    if (volume_usable(preferred, NULL)) {
+        return preferred;
+    }
+
+    // The stream's own volume stays its place, so it returns there once the disk is back
+    int volume = emptiest_volume();
+    if (volume >= 0) {
+        log_warn("Recording stream %s on volume %s while %s is unavailable",
+                 stream_name, volumes[volume].path, volumes[preferred].path);
+        return volume;
+    }
+    return preferred;
+}
+
+int storage_volumes_count(void) {
+    ensure_loaded();
+    return volume_count;
+}
+
+int storage_volume_path(int volume, char *path, size_t size) {
+    ensure_loaded();
+    if (volume < 0 || volume >= volume_count) {
+        return -1;
+    }
+    int n = snprintf(path, size, "%s", volumes[volume].path);
+    return (n > 0 && (size_t)n < size) ? 0 : -1;
+}
+
+int storage_volume_of_path(const char *path) {
+    ensure_loaded();
+    if (!path) {
+        return 0;
+    }
+
+    // A further volume may be mounted below the MP4 storage path, so the longest match wins
+    int best = 0;
+    size_t best_len = 0;
+    for (int i = 1; i < volume_count; i++) {
+        size_t len = strlen(volumes[i].path);
+        if (len > best_len && strncmp(path, volumes[i].path, len) == 0 && path[len] == '/') {
+            best = i;
+            best_len = len;
+        }
+    }
+    return best;
+}
+
+int storage_volume_stream_dir(const char *stream_name, char *dir, size_t size) {
+    ensure_loaded();
+
+    pthread_mutex_lock(&volumes_mutex);
+    int volume = choose_volume(stream_name);
+    int n = snprintf(dir, size, "%s/%s", volumes[volume].path, stream_name);
+    pthread_mutex_unlock(&volumes_mutex);
+
+    return (n > 0 && (size_t)n < size) ? volume : -1;
+}
+
+void storage_volume_failed(const char *path) {
+    ensure_loaded();
+    if (volume_count == 1) {
+        return;
+    }
+
+    int volume = storage_volume_of_path(path);
+    pthread_mutex_lock(&volumes_mutex);
+    volumes[volume].down_until = time(NULL) + VOLUME_RETRY_INTERVAL;
+    pthread_mutex_unlock(&volumes_mutex);
+
+    log_warn("Writing to recording volume %s failed, passing it over for %d seconds",
+             volumes[volume].path, VOLUME_RETRY_INTERVAL);
+}
@@ -0,0 +1,697 @@
+/**
+ * @file upload_worker.c
+ * @brief Background upload of event clips to offsite storage
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <curl/curl.h>
+
+#include "storage/upload_worker.h"
+#include "storage/deletion_worker.h"
+#include "core/logger.h"
+#include "core/config.h"
+#include "core/event_bus.h"
+#include "database/db_core.h"
+#include "database/db_uploads.h"
+#include "video/load_governor.h"
+#include "video/stream_manager.h"
+#include "video/thread_utils.h"
+
+// Size of the parts of S3 multipart uploads; smaller clips are sent whole
+#define UPLOAD_PART_SIZE (16 * 1024 * 1024)
+
+// Most parts S3 takes in one upload; larger clips get larger parts
+#define UPLOAD_MAX_PARTS 10000
+
+// Delay before the first retry, doubled after every further failure
+#define UPLOAD_RETRY_MIN 30
+
+// Longest delay between retries
+#define UPLOAD_RETRY_MAX 3600
+
+// Seconds between queue checks when nothing is due
+#define UPLOAD_CHECK_INTERVAL 300
+
+// Seconds between checks while the load governor sheds work
+#define UPLOAD_LOAD_WAIT 30
+
+// Seconds a transfer may make no progress before it is abandoned
+#define UPLOAD_STALL_TIME 120
+
+// Most of a response body kept, for upload IDs and error codes
+#define UPLOAD_RESPONSE_MAX 16384
+
+typedef enum {
+    UPLOAD_DONE = 0,
+    UPLOAD_FAILED,          // Tried again later
+    UPLOAD_INTERRUPTED,     // Stopped or paused; continued without counting an attempt
+    UPLOAD_GONE             // The file no longer exists
+} upload_result_t;
+
+// Range of the clip sent as one request body
+typedef struct {
+    int fd;
+    off_t start;
+    off_t end;
+    off_t pos;
+} upload_body_t;
+
+// Response to one request
+typedef struct {
+    long status;
+    char etag[128];
+    char body[UPLOAD_RESPONSE_MAX];
+    size_t body_len;
+} upload_response_t;
+
+static struct {
+    pthread_t thread;
+    bool running;
+    bool work_queued;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+} worker = {
+    .running = false,
+    .work_queued = false,
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER
+};
+
+static size_t read_body(char *buffer, size_t size, size_t nitems, void *userdata) {
+    upload_body_t *body = (upload_body_t *)userdata;
+    size_t want = size * nitems;
+    if ((off_t)want > body->end - body->pos) {
+        want = (size_t)(body->end - body->pos);
+    }
+    if (want == 0) {
+        return 0;
+    }
+
+    ssize_t n;
+    do {
+        n = pread(body->fd, buffer, want, body->pos);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) {
+        // Read error, or the file got shorter than announced
+        return CURL_READFUNC_ABORT;
+    }
+    body->pos += n;
+    return (size_t)n;
+}
+
+// Rewind the body when curl has to send it again, such as after a redirect
+static int seek_body(void *userdata, curl_off_t offset, int origin) {
+    upload_body_t *body = (upload_body_t *)userdata;
+    if (origin != SEEK_SET || offset < 0 || offset > body->end - body->start) {
+        return CURL_SEEKFUNC_FAIL;
+    }
+    body->pos = body->start + offset;
+    return CURL_SEEKFUNC_OK;
+}
+
+static size_t read_header(char *buffer, size_t size, size_t nitems, void *userdata) {
+    upload_response_t *response = (upload_response_t *)userdata;
+    size_t len = size * nitems;
+
+    if (len > 5 && strncasecmp(buffer, "ETag:", 5) == 0) {
+        const char *value = buffer + 5;
+        size_t value_len = len - 5;
+        while (value_len > 0 && (*value == ' ' || *value == '\t')) {
+            value++;
+            value_len--;
+        }
+        while (value_len > 0 && (value[value_len - 1] == '\r' || value[value_len - 1] == '\n' ||
+                                 value[value_len - 1] == ' ')) {
+            value_len--;
+        }
+        if (value_len < sizeof(response->etag)) {
+            memcpy(response->etag, value, value_len);
+            response->etag[value_len] = '\0';
+        }
+    }
+    return len;
+}
+
+static size_t read_response(char *buffer, size_t size, size_t nmemb, void *userdata) {
+    upload_response_t *response = (upload_response_t *)userdata;
+    size_t len = size * nmemb;
+    size_t room = sizeof(response->body) - 1 - response->body_len;
+    size_t keep = len < room ? len : room;
+
+    memcpy(response->body + response->body_len, buffer, keep);
+    response->body_len += keep;
+    response->body[response->body_len] = '\0';
+    return len;
+}
+
+// Abort the transfer when the worker is stopped
+static int check_running(void *clientp, curl_off_t dltotal, curl_off_t dlnow,
+                         curl_off_t ultotal, curl_off_t ulnow) {
+    (void)clientp;
+    (void)dltotal;
+    (void)dlnow;
+    (void)ultotal;
+    (void)ulnow;
+    return worker.running ? 0 : 1;
+}
+
+/**
+ * Get the text of the first element with a name in an S3 response
+ *
+ * @return 0 if found, -1 if not or too long
+ */
+static int xml_value(const char *xml, const char *name, char *value, size_t size) {
+    char open[64];
+    char close[64];
+    snprintf(open, sizeof(open), "<%s>", name);
+    snprintf(close, sizeof(close), "</%s>", name);
+
+    const char *start = strstr(xml, open);
+    if (!start) {
+        return -1;
+    }
+    start += strlen(open);
+    const char *end = strstr(start, close);
+    if (!end || (size_t)(end - start) >= size) {
+        return -1;
+    }
+    memcpy(value, start, (size_t)(end - start));
+    value[end - start] = '\0';
+    return 0;
+}
+
+/**
+ * Send one request
+ * With a body, the request is a PUT of that range of the clip; with data,
+ * a POST of it; method overrides either, such as for DELETE.
+ *
+ * @return UPLOAD_DONE once a response arrived, whatever its status
+ */
+static upload_result_t perform_request(const char *url, const char *method, upload_body_t *body,
+                                       const char *data, const char *content_type,
+                                       upload_response_t *response, char *error, size_t error_size) {
+    CURL *curl = curl_easy_init();
+    if (!curl) {
+        snprintf(error, error_size, "Failed to initialize curl");
+        return UPLOAD_FAILED;
+    }
+    memset(response, 0, sizeof(*response));
+
+    curl_easy_setopt(curl, CURLOPT_URL, url);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 30L);
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 1L);
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, (long)UPLOAD_STALL_TIME);
+    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+    curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, check_running);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, read_header);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, response);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, read_response);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, response);
+
+    if (g_config.upload_auth[0] != '\0') {
+        curl_easy_setopt(curl, CURLOPT_USERPWD, g_config.upload_auth);
+    }
+    if (g_config.upload_s3_region[0] != '\0') {
+        char sigv4[64];
+        snprintf(sigv4, sizeof(sigv4), "aws:amz:%s:s3", g_config.upload_s3_region);
+        curl_easy_setopt(curl, CURLOPT_AWS_SIGV4, sigv4);
+    } else if (g_config.upload_auth[0] != '\0') {
+        curl_easy_setopt(curl, CURLOPT_HTTPAUTH, (long)CURLAUTH_BASIC);
+    }
+
+    if (body) {
+        curl_easy_setopt(curl, CURLOPT_UPLOAD, 1L);
+        curl_easy_setopt(curl, CURLOPT_READFUNCTION, read_body);
+        curl_easy_setopt(curl, CURLOPT_READDATA, body);
+        curl_easy_setopt(curl, CURLOPT_SEEKFUNCTION, seek_body);
+        curl_easy_setopt(curl, CURLOPT_SEEKDATA, body);
+        curl_easy_setopt(curl, CURLOPT_INFILESIZE_LARGE, (curl_off_t)(body->end - body->start));
+        // Only one upload runs at a time, so this caps all of them
+        if (g_config.upload_rate_kbps > 0) {
+            curl_easy_setopt(curl, CURLOPT_MAX_SEND_SPEED_LARGE,
+                             (curl_off_t)g_config.upload_rate_kbps * 1024);
+        }
+    } else if (data) {
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, data);
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, (long)strlen(data));
+    }
+    if (method) {
+        curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, method);
+    }
+
+    struct curl_slist *headers = NULL;
+    if (content_type) {
+        char header[64];
+        snprintf(header, sizeof(header), "Content-Type: %s", content_type);
+        headers = curl_slist_append(headers, header);
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+    }
+
+    CURLcode rc = curl_easy_perform(curl);
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response->status);
+    curl_slist_free_all(headers);
+    curl_easy_cleanup(curl);
+
+    if (rc == CURLE_ABORTED_BY_CALLBACK) {
+        return UPLOAD_INTERRUPTED;
+    }
+    if (rc != CURLE_OK) {
+        snprintf(error, error_size, "%s", curl_easy_strerror(rc));
+        return UPLOAD_FAILED;
+    }
+    return UPLOAD_DONE;
+}
+
+// Describe an unexpected response, with the S3 error code if there is one
+static void describe_response(const upload_response_t *response, char *error, size_t error_size) {
+    char code[64];
+    if (xml_value(response->body, "Code", code, sizeof(code)) == 0) {
+        snprintf(error, error_size, "HTTP %ld: %s", response->status, code);
+    } else {
+        snprintf(error, error_size, "HTTP %ld", response->status);
+    }
+}
+
+/**
+ * Build the URL of the object a recording is uploaded to
+ *
+ * @param query Query to append, or NULL
+ */
+static int object_url(const upload_entry_t *entry, const char *query, char *url, size_t size) {
+    size_t len = strlen(g_config.upload_url);
+    while (len > 0 && g_config.upload_url[len - 1] == '/') {
+        len--;
+    }
+    const char *base = strrchr(entry->file_path, '/');
+    char *stream = curl_easy_escape(NULL, entry->stream_name, 0);
+    char *name = curl_easy_escape(NULL, base ? base + 1 : entry->file_path, 0);
+    if (!stream || !name) {
+        curl_free(stream);
+        curl_free(name);
+        return -1;
+    }
+
+    int n = snprintf(url, size, "%.*s/%s/%s%s%s", (int)len, g_config.upload_url, stream, name,
+                     query ? "?" : "", query ? query : "");
+    curl_free(stream);
+    curl_free(name);
+    return (n > 0 && (size_t)n < size) ? 0 : -1;
+}
+
+// Build the URL of a request within a multipart upload
+static int multipart_url(const upload_entry_t *entry, int part, char *url, size_t size) {
+    char *upload_id = curl_easy_escape(NULL, entry->upload_id, 0);
+    if (!upload_id) {
+        return -1;
+    }
+    char query[512];
+    if (part > 0) {
+        snprintf(query, sizeof(query), "partNumber=%d&uploadId=%s", part, upload_id);
+    } else {
+        snprintf(query, sizeof(query), "uploadId=%s", upload_id);
+    }
+    curl_free(upload_id);
+    return object_url(entry, query, url, size);
+}
+
+// Send a clip in one request
+static upload_result_t upload_whole(const upload_entry_t *entry, int fd, off_t size,
+                                    char *error, size_t error_size) {
+    char url[MAX_URL_LENGTH + 512];
+    if (object_url(entry, NULL, url, sizeof(url)) != 0) {
+        snprintf(error, error_size, "Upload URL too long");
+        return UPLOAD_FAILED;
+    }
+
+    upload_body_t body = { .fd = fd, .start = 0, .end = size, .pos = 0 };
+    upload_response_t *response = malloc(sizeof(*response));
+    if (!response) {
+        snprintf(error, error_size, "Out of memory");
+        return UPLOAD_FAILED;
+    }
+
+    upload_result_t result = perform_request(url, NULL, &body, NULL, "video/mp4", response,
+                                             error, error_size);
+    if (result == UPLOAD_DONE && (response->status < 200 || response->status >= 300)) {
+        describe_response(response, error, error_size);
+        result = UPLOAD_FAILED;
+    }
+    free(response);
+    return result;
+}
+
+/**
+ * Forget a multipart upload the server no longer knows, so the next
+ * attempt starts a new one
+ */
+static void restart_multipart(upload_entry_t *entry) {
+    entry->upload_id[0] = '\0';
+    entry->parts[0] = '\0';
+    set_upload_progress(entry->id, NULL, NULL);
+}
+
+/**
+ * Send a clip as an S3 multipart upload, continuing after the parts a
+ * previous attempt finished
+ */
+static upload_result_t upload_multipart(upload_entry_t *entry, int fd, off_t size,
+                                        char *error, size_t error_size) {
+    // The part size only depends on the clip size, so it stays the same across attempts
+    off_t part_size = UPLOAD_PART_SIZE;
+    if ((size + part_size - 1) / part_size > UPLOAD_MAX_PARTS) {
+        part_size = (size + UPLOAD_MAX_PARTS - 1) / UPLOAD_MAX_PARTS;
+    }
+    int part_count = (int)((size + part_size - 1) / part_size);
+
+    char url[MAX_URL_LENGTH + 1024];
+    upload_response_t *response = malloc(sizeof(*response));
+    // Every ETag is at most sizeof(response->etag), plus a comma
+    size_t parts_size = (size_t)part_count * sizeof(response->etag) + 1;
+    char *parts = malloc(parts_size);
+    char *xml = malloc((size_t)part_count * (sizeof(response->etag) + 64) + 128);
+    upload_result_t result = UPLOAD_FAILED;
+    if (!response || !parts || !xml) {
+        snprintf(error, error_size, "Out of memory");
+        goto done;
+    }
+
+    if (entry->upload_id[0] == '\0') {
+        if (object_url(entry, "uploads", url, sizeof(url)) != 0) {
+            snprintf(error, error_size, "Upload URL too long");
+            goto done;
+        }
+        result = perform_request(url, NULL, NULL, "", "application/xml", response, error, error_size);
+        if (result != UPLOAD_DONE) {
+            goto done;
+        }
+        if (response->status != 200 ||
+            xml_value(response->body, "UploadId", entry->upload_id, sizeof(entry->upload_id)) != 0) {
+            entry->upload_id[0] = '\0';
+            describe_response(response, error, error_size);
+            result = UPLOAD_FAILED;
+            goto done;
+        }
+        entry->parts[0] = '\0';
+        set_upload_progress(entry->id, entry->upload_id, "");
+    }
+
+    snprintf(parts, parts_size, "%s", entry->parts);
+    int done_count = 0;
+    if (parts[0] != '\0') {
+        done_count = 1;
+        for (const char *p = parts; *p; p++) {
+            done_count += *p == ',';
+        }
+    }
+
+    for (int part = done_count + 1; part <= part_count; part++) {
+        // Yield between parts to a stop or to the load governor
+        if (!worker.running || load_governor_level() != LOAD_SHED_NONE) {
+            result = UPLOAD_INTERRUPTED;
+            goto done;
+        }
+        if (multipart_url(entry, part, url, sizeof(url)) != 0) {
+            snprintf(error, error_size, "Upload URL too long");
+            result = UPLOAD_FAILED;
+            goto done;
+        }
+
+        off_t start = (off_t)(part - 1) * part_size;
+        upload_body_t body = {
+            .fd = fd,
+            .start = start,
+            .end = start + part_size < size ? start + part_size : size,
+            .pos = start
+        };
+        result = perform_request(url, NULL, &body, NULL, NULL, response, error, error_size);
+        if (result != UPLOAD_DONE) {
+            goto done;
+        }
+        if (response->status == 404) {
+            // The upload expired or was aborted on the server
+            describe_response(response, error, error_size);
+            restart_multipart(entry);
+            result = UPLOAD_FAILED;
+            goto done;
+        }
+        if (response->status != 200 || response->etag[0] == '\0') {
+            describe_response(response, error, error_size);
+            result = UPLOAD_FAILED;
+            goto done;
+        }
+
+        size_t len = strlen(parts);
+        snprintf(parts + len, parts_size - len, "%s%s", len > 0 ? "," : "", response->etag);
+        set_upload_progress(entry->id, entry->upload_id, parts);
+    }
+
+    size_t pos = (size_t)sprintf(xml, "<CompleteMultipartUpload>");
+    int part = 1;
+    char *saveptr = NULL;
+    for (char *etag = strtok_r(parts, ",", &saveptr); etag; etag = strtok_r(NULL, ",", &saveptr), part++) {
+        pos += (size_t)sprintf(xml + pos, "<Part><PartNumber>%d</PartNumber><ETag>%s</ETag></Part>",
+                               part, etag);
+    }
+    sprintf(xml + pos, "</CompleteMultipartUpload>");
+
+    if (multipart_url(entry, 0, url, sizeof(url)) != 0) {
+        snprintf(error, error_size, "Upload URL too long");
+        result = UPLOAD_FAILED;
+        goto done;
+    }
+    result = perform_request(url, NULL, NULL, xml, "application/xml", response, error, error_size);
+    if (result != UPLOAD_DONE) {
+        goto done;
+    }
+    // S3 can report a failed completion in the body of a 200
+    if (response->status != 200 || strstr(response->body, "<Error>")) {
+        describe_response(response, error, error_size);
+        if (response->status == 404) {
+            restart_multipart(entry);
+        }
+        result = UPLOAD_FAILED;
+    }
+
+done:
+    free(response);
+    free(parts);
+    free(xml);
+    return result;
+}
+
+// Abort a multipart upload that is given up, so the server drops its parts
+static void abort_multipart(const upload_entry_t *entry) {
+    char url[MAX_URL_LENGTH + 1024];
+    char error[128];
+    upload_response_t *response = malloc(sizeof(*response));
+    if (response && multipart_url(entry, 0, url, sizeof(url)) == 0) {
+        perform_request(url, "DELETE", NULL, NULL, NULL, response, error, sizeof(error));
+    }
+    free(response);
+}
+
+static upload_result_t upload_recording(upload_entry_t *entry, char *error, size_t error_size) {
+    int fd = open(entry->file_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        snprintf(error, error_size, "%s", strerror(errno));
+        return errno == ENOENT ? UPLOAD_GONE : UPLOAD_FAILED;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        snprintf(error, error_size, "Not a regular file");
+        close(fd);
+        return UPLOAD_GONE;
+    }
+
+    upload_result_t result;
+    if (g_config.upload_s3_region[0] != '\0' && st.st_size > UPLOAD_PART_SIZE) {
+        result = upload_multipart(entry, fd, st.st_size, error, error_size);
+    } else {
+        result = upload_whole(entry, fd, st.st_size, error, error_size);
+    }
+    close(fd);
+    return result;
+}
+
+static void process_upload(upload_entry_t *entry) {
+    if (entry->file_path[0] == '\0') {
+        log_debug("Recording %llu was deleted before it was uploaded",
+                  (unsigned long long)entry->recording_id);
+        remove_upload(entry->id);
+        return;
+    }
+
+    char error[256] = "";
+    upload_result_t result = upload_recording(entry, error, sizeof(error));
+    switch (result) {
+        case UPLOAD_DONE:
+            log_info("Uploaded recording %llu (%s)", (unsigned long long)entry->recording_id,
+                     entry->file_path);
+            remove_upload(entry->id);
+            break;
+
+        case UPLOAD_GONE:
+            log_warn("Recording file %s is gone, not uploading it: %s", entry->file_path, error);
+            remove_upload(entry->id);
+            break;
+
+        case UPLOAD_INTERRUPTED:
+            break;
+
+        case UPLOAD_FAILED: {
+            int attempts = entry->attempts + 1;
+            if (attempts >= g_config.upload_max_attempts) {
+                log_error("Giving up uploading recording %llu after %d attempts: %s",
+                          (unsigned long long)entry->recording_id, attempts, error);
+                if (entry->upload_id[0] != '\0') {
+                    abort_multipart(entry);
+                }
+                remove_upload(entry->id);
+                break;
+            }
+
+            int shift = attempts - 1 < 7 ? attempts - 1 : 7;
+            int delay = UPLOAD_RETRY_MIN << shift;
+            if (delay > UPLOAD_RETRY_MAX) {
+                delay = UPLOAD_RETRY_MAX;
+            }
+            log_warn("Failed to upload recording %llu, trying again in %d seconds: %s",
+                     (unsigned long long)entry->recording_id, delay, error);
+            retry_upload(entry->id, attempts, time(NULL) + delay, error);
+            break;
+        }
+    }
+}
+
+static void *upload_worker_thread(void *arg) {
+    (void)arg;
+    thread_set_identity(THREAD_CLASS_SERVICE, "upload", NULL);
+    lower_thread_priority();
+    log_info("Upload worker started for %s", g_config.upload_url);
+
+    pthread_mutex_lock(&worker.mutex);
+    while (worker.running) {
+        worker.work_queued = false;
+        pthread_mutex_unlock(&worker.mutex);
+
+        int wait = UPLOAD_CHECK_INTERVAL;
+        if (load_governor_level() != LOAD_SHED_NONE) {
+            wait = UPLOAD_LOAD_WAIT;
+        } else if (get_db_handle()) {
+            upload_entry_t entry;
+            time_t next;
+            if (get_next_upload(time(NULL), &entry) > 0) {
+                process_upload(&entry);
+                free(entry.parts);
+                wait = 0;
+            } else if (get_next_upload_time(&next) > 0) {
+                time_t until = next - time(NULL);
+                wait = until < 1 ? 1 : until < UPLOAD_CHECK_INTERVAL ? (int)until : UPLOAD_CHECK_INTERVAL;
+            }
+        }
+        pthread_mutex_lock(&worker.mutex);
+
+        if (worker.running && wait > 0 && !worker.work_queued) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += wait;
+            pthread_cond_timedwait(&worker.cond, &worker.mutex, &deadline);
+        }
+    }
+    pthread_mutex_unlock(&worker.mutex);
+
+    log_info("Upload worker stopped");
+    return NULL;
+}
+
+bool upload_worker_enabled(void) {
+    return g_config.upload_url[0] != '\0';
+}
+
+int upload_worker_queue(uint64_t recording_id) {
+    if (add_upload(recording_id) != 0) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&worker.mutex);
+    worker.work_queued = true;
+    pthread_cond_signal(&worker.cond);
+    pthread_mutex_unlock(&worker.mutex);
+    return 0;
+}
+
+/**
+ * Queue the recordings of detection-based streams the MP4 writers announce as finished
+ */
+static void recording_finished_handler(const bus_event_t *event, void *ctx) {
+    (void)ctx;
+    if (event->recording_id == 0 || !upload_worker_enabled()) {
+        return;
+    }
+
+    stream_handle_t stream = get_stream_by_name(event->stream_name);
+    stream_config_t config;
+    if (!stream || get_stream_config(stream, &config) != 0 || !config.detection_based_recording) {
+        return;
+    }
+
+    if (upload_worker_queue(event->recording_id) != 0) {
+        log_warn("Failed to queue recording %llu of stream %s for upload",
+                 (unsigned long long)event->recording_id, event->stream_name);
+    }
+}
+
+int start_upload_worker(void) {
+    if (!upload_worker_enabled()) {
+        return 0;
+    }
+
+    if (event_bus_subscribe("uploads", BUS_EVENT_MASK(BUS_EVENT_RECORDING_FINISHED), 0,
+                            recording_finished_handler, NULL) != 0) {
+        log_error("Failed to subscribe the upload worker to finished recordings");
+    }
+
+    pthread_mutex_lock(&worker.mutex);
+    if (worker.running) {
+        pthread_mutex_unlock(&worker.mutex);
+        return 0;
+    }
+
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    worker.running = true;
+    if (pthread_create(&worker.thread, NULL, upload_worker_thread, NULL) != 0) {
+        log_error("Failed to create upload worker thread: %s", strerror(errno));
+        worker.running = false;
+        pthread_mutex_unlock(&worker.mutex);
+        return -1;
+    }
+    pthread_mutex_unlock(&worker.mutex);
+    return 0;
+}
+
+void stop_upload_worker(void) {
+    pthread_mutex_lock(&worker.mutex);
+    if (!worker.running) {
+        pthread_mutex_unlock(&worker.mutex);
+        return;
+    }
+    worker.running = false;
+    pthread_cond_signal(&worker.cond);
+    pthread_mutex_unlock(&worker.mutex);
+
+    pthread_join(worker.thread, NULL);
+}
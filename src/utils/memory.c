@@ -3,13 +3,12 @@
 #include <string.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
 
 #include "utils/memory.h"
 #include "core/logger.h"
-
-// Memory tracking variables
-static size_t total_memory_allocated = 0;
-static size_t peak_memory_allocated = 0;
+#include "core/metrics.h"
 
 // Safe memory allocation
 void *safe_malloc(size_t size) {
@@ -99,31 +98,202 @@ void secure_zero_memory(void *ptr, size_t size) {
     }
 }
 
-// Track memory allocations
-void track_memory_allocation(size_t size, bool is_allocation) {
-    if (is_allocation) {
-        total_memory_allocated += size;
-        if (total_memory_allocated > peak_memory_allocated) {
-            peak_memory_allocated = total_memory_allocated;
-        }
+// Shared totals per tag; threads fold their own counters into these
+static atomic_int_fast64_t tag_current[MEMORY_TAG_COUNT];
+static atomic_int_fast64_t tag_peak[MEMORY_TAG_COUNT];
+static atomic_int_fast64_t total_current;
+static atomic_int_fast64_t total_peak;
+
+// Tags whose subsystem measures its own usage
+static size_t (*_Atomic usage_sources[MEMORY_TAG_COUNT])(void);
+
+static atomic_size_t memory_budget;
+static atomic_bool over_budget;
+
+// Counters of the calling thread not yet in the shared totals
+static _Thread_local int64_t pending[MEMORY_TAG_COUNT];
+static _Thread_local bool thread_registered;
+
+static pthread_key_t flush_key;
+static pthread_once_t flush_key_once = PTHREAD_ONCE_INIT;
+
+static const char *const tag_names[MEMORY_TAG_COUNT] = {
+    "other", "ingest", "hls", "mp4", "detection", "models", "db", "web", "logger"
+};
+
+static metric_t current_metrics[MEMORY_TAG_COUNT];
+static metric_t peak_metrics[MEMORY_TAG_COUNT];
+static metric_t budget_metric;
+
+static void raise_peak(atomic_int_fast64_t *peak, int64_t value) {
+    int64_t seen = atomic_load_explicit(peak, memory_order_relaxed);
+    while (value > seen &&
+           !atomic_compare_exchange_weak_explicit(peak, &seen, value, memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+static void flush_tag(int tag) {
+    int64_t delta = pending[tag];
+    if (delta == 0) {
+        return;
+    }
+    pending[tag] = 0;
+
+    int64_t current = atomic_fetch_add_explicit(&tag_current[tag], delta, memory_order_relaxed) + delta;
+    int64_t total = atomic_fetch_add_explicit(&total_current, delta, memory_order_relaxed) + delta;
+    if (delta > 0) {
+        raise_peak(&tag_peak[tag], current);
+        raise_peak(&total_peak, total);
+    }
+}
+
+// Runs when a thread that tracked memory exits; its thread-locals are still valid here
+static void flush_thread(void *arg) {
+    (void)arg;
+    for (int tag = 0; tag < MEMORY_TAG_COUNT; tag++) {
+        flush_tag(tag);
+    }
+}
+
+static void create_flush_key(void) {
+    pthread_key_create(&flush_key, flush_thread);
+}
+
+void memory_track(memory_tag_t tag, size_t size, bool is_allocation) {
+    if ((unsigned int)tag >= MEMORY_TAG_COUNT || size == 0) {
+        return;
+    }
+
+    if (!thread_registered) {
+        pthread_once(&flush_key_once, create_flush_key);
+        // Any non-NULL value makes the destructor run at thread exit
+        pthread_setspecific(flush_key, (void *)1);
+        thread_registered = true;
+    }
+
+    pending[tag] += is_allocation ? (int64_t)size : -(int64_t)size;
+    if (pending[tag] >= MEMORY_FLUSH_BYTES || pending[tag] <= -MEMORY_FLUSH_BYTES) {
+        flush_tag(tag);
+    }
+}
+
+void memory_set_usage_source(memory_tag_t tag, size_t (*usage)(void)) {
+    if ((unsigned int)tag < MEMORY_TAG_COUNT) {
+        atomic_store(&usage_sources[tag], usage);
+    }
+}
+
+static size_t tag_usage(int tag, size_t *peak) {
+    size_t (*source)(void) = atomic_load(&usage_sources[tag]);
+    int64_t current;
+    if (source) {
+        current = (int64_t)source();
+        raise_peak(&tag_peak[tag], current);
     } else {
-        if (size <= total_memory_allocated) {
-            total_memory_allocated -= size;
-        } else {
-            // This should not happen, but handle it gracefully
-            log_warn("Memory tracking inconsistency: trying to free %zu bytes when only %zu are tracked",
-                    size, total_memory_allocated);
-            total_memory_allocated = 0;
-        }
+        current = atomic_load_explicit(&tag_current[tag], memory_order_relaxed);
+    }
+
+    // Frees may be folded in before the allocations they release
+    if (current < 0) {
+        current = 0;
+    }
+    if (peak) {
+        int64_t p = atomic_load_explicit(&tag_peak[tag], memory_order_relaxed);
+        *peak = (size_t)(p > current ? p : current);
     }
+    return (size_t)current;
+}
+
+void memory_get_usage(memory_usage_t usage[MEMORY_TAG_COUNT]) {
+    for (int tag = 0; tag < MEMORY_TAG_COUNT; tag++) {
+        usage[tag].current = tag_usage(tag, &usage[tag].peak);
+    }
+}
+
+// Track memory allocations
+void track_memory_allocation(size_t size, bool is_allocation) {
+    memory_track(MEMORY_TAG_OTHER, size, is_allocation);
 }
 
 // Get total memory allocated
 size_t get_total_memory_allocated(void) {
-    return total_memory_allocated;
+    size_t total = 0;
+    for (int tag = 0; tag < MEMORY_TAG_COUNT; tag++) {
+        total += tag_usage(tag, NULL);
+    }
+    return total;
 }
 
 // Get peak memory allocated
 size_t get_peak_memory_allocated(void) {
-    return peak_memory_allocated;
+    // Self-measured tags are not in the running total, so their peaks are added
+    int64_t peak = atomic_load_explicit(&total_peak, memory_order_relaxed);
+    for (int tag = 0; tag < MEMORY_TAG_COUNT; tag++) {
+        if (atomic_load(&usage_sources[tag])) {
+            peak += atomic_load_explicit(&tag_peak[tag], memory_order_relaxed);
+        }
+    }
+    return peak > 0 ? (size_t)peak : 0;
+}
+
+size_t memory_get_budget(void) {
+    return atomic_load(&memory_budget);
+}
+
+bool memory_budget_allows(memory_tag_t tag, size_t size) {
+    size_t budget = atomic_load(&memory_budget);
+    if (budget == 0) {
+        return true;
+    }
+
+    size_t total = get_total_memory_allocated();
+    bool allowed = total + size <= budget;
+
+    // Log the transitions only, callers ask on every frame
+    bool was_over = atomic_exchange(&over_budget, !allowed);
+    if (!allowed && !was_over) {
+        log_warn("Memory budget exceeded: %zu KB tracked of %zu KB, %s is skipping optional work",
+                 total / 1024, budget / 1024, memory_tag_name(tag));
+    } else if (allowed && was_over) {
+        log_info("Memory back under budget: %zu KB tracked of %zu KB", total / 1024, budget / 1024);
+    }
+    return allowed;
+}
+
+const char *memory_tag_name(memory_tag_t tag) {
+    if ((unsigned int)tag >= MEMORY_TAG_COUNT) {
+        return "unknown";
+    }
+    return tag_names[tag];
+}
+
+// Refresh the gauges before a scrape
+static void collect_memory_metrics(void) {
+    memory_usage_t usage[MEMORY_TAG_COUNT];
+    memory_get_usage(usage);
+    for (int tag = 0; tag < MEMORY_TAG_COUNT; tag++) {
+        metrics_set(current_metrics[tag], usage[tag].current);
+        metrics_set(peak_metrics[tag], usage[tag].peak);
+    }
+    metrics_set(budget_metric, memory_get_budget());
+}
+
+void memory_accounting_init(size_t budget_bytes) {
+    atomic_store(&memory_budget, budget_bytes);
+
+    for (int tag = 0; tag < MEMORY_TAG_COUNT; tag++) {
+        current_metrics[tag] = metrics_gauge("lightnvr_memory_bytes",
+                                             "Memory in use by subsystem",
+                                             "subsystem", tag_names[tag], NULL);
+        peak_metrics[tag] = metrics_gauge("lightnvr_memory_peak_bytes",
+                                          "Most memory in use by subsystem since startup",
+                                          "subsystem", tag_names[tag], NULL);
+    }
+    budget_metric = metrics_gauge("lightnvr_memory_budget_bytes",
+                                  "Memory budget, 0 when none is set", NULL);
+    metrics_add_collector(collect_memory_metrics);
+
+    if (budget_bytes > 0) {
+        log_info("Memory budget set to %zu MB", budget_bytes / (1024 * 1024));
+    }
 }
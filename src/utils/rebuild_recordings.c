@@ -5,6 +5,16 @@
  * This utility scans the recordings directory, checks if each recording is in the database,
  * and adds missing recordings. If a recording's stream doesn't exist, it creates a
  * soft-deleted stream with the same name and a dummy URL.
+ *
+ * Stream directories are scanned by a pool of threads. Paths already in the
+ * database are loaded into a hash set up front, durations and video properties
+ * are read from the MP4 box headers (FFmpeg only probes files where that
+ * fails), and recordings are added in batched transactions.
+ *
+ * With --migrate-layout, recordings still directly in their stream directory
+ * are then moved into the sharded <stream>/YYYY/MM/DD/HH/ layout (see
+ * recording_layout.h) and their paths updated in the database. lightnvr
+ * must not be running while they are moved.
  */
 
 #include <stdio.h>
@@ -17,6 +27,10 @@
 #include <errno.h>
 #include <time.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <strings.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <libavformat/avformat.h>
 #include <libavcodec/avcodec.h>
 #include <libavutil/avutil.h>
@@ -28,10 +42,26 @@
 #include "database/db_recordings.h"
 #include "database/db_schema.h"
 #include "database/db_schema_cache.h"
+#include "storage/recording_layout.h"
 
 // Dummy URL for soft-deleted streams
 #define DUMMY_URL "rtsp://dummy.url/stream"
 
+// Maximum number of directory scanning threads
+#define MAX_SCAN_THREADS 8
+
+// Recordings added to the database per transaction
+#define INSERT_BATCH_SIZE 500
+
+// Scanned files waiting for the database thread
+#define RESULT_QUEUE_SIZE 1024
+
+// Largest moov box read when parsing a recording
+#define MAX_MOOV_SIZE (16 * 1024 * 1024)
+
+#define BOX_TYPE(a, b, c, d) \
+    (((uint32_t)(a) << 24) | ((uint32_t)(b) << 16) | ((uint32_t)(c) << 8) | (uint32_t)(d))
+
 // Structure to hold recording file information
 typedef struct {
     char path[MAX_PATH_LENGTH];
@@ -45,37 +75,144 @@ typedef struct {
     char codec[16];
 } recording_file_info_t;
 
+// Set of strings, open addressing with linear probing
+typedef struct {
+    char **slots;
+    size_t capacity;
+    size_t count;
+} string_set_t;
+
+// State shared by the scanning threads and the database thread
+typedef struct {
+    char (*dirs)[MAX_PATH_LENGTH];
+    int dir_count;
+    int next_dir;
+    int active_workers;
+    const string_set_t *known_paths;
+    
+    recording_file_info_t *queue;
+    int queue_head;
+    int queue_count;
+    
+    int processed_count;
+    int failed_count;
+    
+    pthread_mutex_t mutex;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+} scan_state_t;
+
+// FNV-1a hash of a string
+static uint64_t hash_string(const char *str) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (const unsigned char *p = (const unsigned char *)str; *p; p++) {
+        hash ^= *p;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static bool string_set_contains(const string_set_t *set, const char *str) {
+    if (set->capacity == 0) {
+        return false;
+    }
+    
+    size_t i = hash_string(str) & (set->capacity - 1);
+    while (set->slots[i]) {
+        if (strcmp(set->slots[i], str) == 0) {
+            return true;
+        }
+        i = (i + 1) & (set->capacity - 1);
+    }
+    return false;
+}
+
+static bool string_set_add(string_set_t *set, const char *str) {
+    // Keep the load factor below 1/2
+    if ((set->count + 1) * 2 > set->capacity) {
+        size_t capacity = set->capacity ? set->capacity * 2 : 1024;
+        char **slots = calloc(capacity, sizeof(char *));
+        if (!slots) {
+            return false;
+        }
+        
+        for (size_t j = 0; j < set->capacity; j++) {
+            if (set->slots[j]) {
+                size_t i = hash_string(set->slots[j]) & (capacity - 1);
+                while (slots[i]) {
+                    i = (i + 1) & (capacity - 1);
+                }
+                slots[i] = set->slots[j];
+            }
+        }
+        
+        free(set->slots);
+        set->slots = slots;
+        set->capacity = capacity;
+    }
+    
+    size_t i = hash_string(str) & (set->capacity - 1);
+    while (set->slots[i]) {
+        if (strcmp(set->slots[i], str) == 0) {
+            return true;
+        }
+        i = (i + 1) & (set->capacity - 1);
+    }
+    
+    set->slots[i] = strdup(str);
+    if (!set->slots[i]) {
+        return false;
+    }
+    set->count++;
+    return true;
+}
+
+static void string_set_free(string_set_t *set) {
+    for (size_t i = 0; i < set->capacity; i++) {
+        free(set->slots[i]);
+    }
+    free(set->slots);
+    memset(set, 0, sizeof(*set));
+}
+
 /**
- * Check if a recording exists in the database
+ * Load the file paths of all recordings in the database
  * 
- * @param file_path Path to the recording file
- * @return true if the recording exists in the database, false otherwise
+ * @param paths Set to fill
+ * @return 0 on success, -1 on error
  */
-static bool recording_exists_in_db(const char *file_path) {
-    recording_metadata_t *metadata;
-    int count, i;
-    bool exists = false;
+static int load_recording_paths(string_set_t *paths) {
+    sqlite3 *db = get_db_handle();
+    pthread_mutex_t *db_mutex = get_db_mutex();
     
-    // Allocate memory for metadata (assuming a reasonable maximum)
-    metadata = (recording_metadata_t *)malloc(1000 * sizeof(recording_metadata_t));
-    if (!metadata) {
-        log_error("Failed to allocate memory for recording metadata");
-        return false;
+    if (!db) {
+        log_error("Database not initialized");
+        return -1;
     }
     
-    // Get all recordings from the database
-    count = get_recording_metadata(0, 0, NULL, metadata, 1000);
+    lock_db_mutex();
+    
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, "SELECT file_path FROM recordings;", -1, &stmt, NULL) != SQLITE_OK) {
+        log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+        pthread_mutex_unlock(db_mutex);
+        return -1;
+    }
     
-    // Check if the file path exists in the database
-    for (i = 0; i < count; i++) {
-        if (strcmp(metadata[i].file_path, file_path) == 0) {
-            exists = true;
+    int result = 0;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const char *path = (const char *)sqlite3_column_text(stmt, 0);
+        if (path && !string_set_add(paths, path)) {
+            log_error("Failed to allocate memory for recording paths");
+            result = -1;
             break;
         }
     }
     
-    free(metadata);
-    return exists;
+    sqlite3_finalize(stmt);
+    pthread_mutex_unlock(db_mutex);
+    
+    return result;
 }
 
 /**
@@ -107,7 +244,7 @@ static bool stream_exists_in_db(const char *stream_name, bool *is_disabled) {
         return false;
     }
     
-    pthread_mutex_lock(db_mutex);
+    lock_db_mutex();
     
     sqlite3_stmt *stmt;
     const char *sql = "SELECT id FROM streams WHERE name = ? AND enabled = 0;";
@@ -179,54 +316,314 @@ static bool create_disabled_stream(const char *stream_name) {
     return true;
 }
 
+static uint32_t read_u32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static uint64_t read_u64(const uint8_t *p) {
+    return ((uint64_t)read_u32(p) << 32) | read_u32(p + 4);
+}
+
 /**
- * Extract recording information from a file path
+ * Find the next box of a type among the boxes in a buffer
  * 
- * @param file_path Path to the recording file
- * @param info Pointer to recording_file_info_t structure to fill
- * @return true if information was extracted successfully, false otherwise
+ * @param data Buffer holding a sequence of boxes
+ * @param size Size of the buffer
+ * @param pos Offset to start at; advanced past the box found
+ * @param type Box type
+ * @param box_size Receives the size of the box payload
+ * @return Pointer to the box payload, or NULL if not found
  */
-static bool extract_recording_info(const char *file_path, recording_file_info_t *info) {
-    AVFormatContext *format_ctx = NULL;
-    AVCodecParameters *codec_params = NULL;
-    int video_stream_index = -1;
-    int i;
-    struct stat st;
+static const uint8_t *next_box(const uint8_t *data, size_t size, size_t *pos,
+                               uint32_t type, size_t *box_size) {
+    while (*pos + 8 <= size) {
+        const uint8_t *box = data + *pos;
+        uint64_t length = read_u32(box);
+        size_t header = 8;
+        
+        if (length == 1) {
+            if (*pos + 16 > size) {
+                break;
+            }
+            length = read_u64(box + 8);
+            header = 16;
+        } else if (length == 0) {
+            length = size - *pos;
+        }
+        
+        if (length < header || length > size - *pos) {
+            break;
+        }
+        
+        *pos += length;
+        if (read_u32(box + 4) == type) {
+            *box_size = length - header;
+            return box + header;
+        }
+    }
+    return NULL;
+}
+
+static const uint8_t *find_box(const uint8_t *data, size_t size, uint32_t type, size_t *box_size) {
+    size_t pos = 0;
+    return data ? next_box(data, size, &pos, type, box_size) : NULL;
+}
+
+/**
+ * Read the moov box of an MP4 file
+ * Only the top-level box headers are read to find it, so this costs a few
+ * small reads however large the media data is.
+ * 
+ * @param fd File descriptor
+ * @param file_size Size of the file
+ * @param size Receives the size of the moov payload
+ * @return The moov payload, to be freed by the caller, or NULL if not found
+ */
+static uint8_t *read_moov(int fd, uint64_t file_size, size_t *size) {
+    uint64_t pos = 0;
     
-    // Initialize info structure
-    memset(info, 0, sizeof(recording_file_info_t));
-    strncpy(info->path, file_path, MAX_PATH_LENGTH - 1);
+    while (pos + 8 <= file_size) {
+        uint8_t header[16];
+        if (pread(fd, header, sizeof(header), (off_t)pos) < 8) {
+            return NULL;
+        }
+        
+        uint64_t length = read_u32(header);
+        uint64_t header_size = 8;
+        if (length == 1) {
+            length = read_u64(header + 8);
+            header_size = 16;
+        } else if (length == 0) {
+            length = file_size - pos;
+        }
+        
+        if (length < header_size || length > file_size - pos) {
+            return NULL;
+        }
+        
+        if (read_u32(header + 4) == BOX_TYPE('m', 'o', 'o', 'v')) {
+            uint64_t payload_size = length - header_size;
+            if (payload_size > MAX_MOOV_SIZE) {
+                return NULL;
+            }
+            
+            uint8_t *moov = malloc(payload_size ? payload_size : 1);
+            if (!moov) {
+                return NULL;
+            }
+            if (pread(fd, moov, payload_size, (off_t)(pos + header_size)) != (ssize_t)payload_size) {
+                free(moov);
+                return NULL;
+            }
+            *size = payload_size;
+            return moov;
+        }
+        
+        pos += length;
+    }
+    return NULL;
+}
+
+// Read the timescale and duration of an mvhd or mdhd payload
+static bool read_box_duration(const uint8_t *box, size_t size, uint32_t *timescale, uint64_t *duration) {
+    if (!box) {
+        return false;
+    }
     
-    // Extract stream name from path
-    // Assuming path format: /storage_path/mp4/stream_name/recording.mp4
-    const char *mp4_pos = strstr(file_path, "/mp4/");
-    if (!mp4_pos) {
-        log_error("Invalid recording path format: %s", file_path);
+    if (box[0] == 1) {
+        if (size < 32) {
+            return false;
+        }
+        *timescale = read_u32(box + 20);
+        *duration = read_u64(box + 24);
+        if (*duration == UINT64_MAX) {
+            *duration = 0;
+        }
+    } else {
+        if (size < 20) {
+            return false;
+        }
+        *timescale = read_u32(box + 12);
+        *duration = read_u32(box + 16);
+        if (*duration == UINT32_MAX) {
+            *duration = 0;
+        }
+    }
+    return true;
+}
+
+// Map a sample entry type to the codec names FFmpeg uses
+static const char *sample_entry_codec(uint32_t format) {
+    switch (format) {
+        case BOX_TYPE('a', 'v', 'c', '1'):
+        case BOX_TYPE('a', 'v', 'c', '3'):
+            return "h264";
+        case BOX_TYPE('h', 'v', 'c', '1'):
+        case BOX_TYPE('h', 'e', 'v', '1'):
+            return "hevc";
+        case BOX_TYPE('m', 'p', '4', 'v'):
+            return "mpeg4";
+        case BOX_TYPE('m', 'j', 'p', 'a'):
+            return "mjpeg";
+        default:
+            return "unknown";
+    }
+}
+
+/**
+ * Read the video properties of a video track
+ * 
+ * @param trak trak payload
+ * @param trak_size Size of the trak payload
+ * @param mvex mvex payload of the movie, NULL if not fragmented
+ * @param mvex_size Size of the mvex payload
+ * @param info Receives width, height, fps and codec
+ * @return true if the track is a video track, false otherwise
+ */
+static bool parse_video_track(const uint8_t *trak, size_t trak_size,
+                              const uint8_t *mvex, size_t mvex_size,
+                              recording_file_info_t *info) {
+    size_t mdia_size, hdlr_size, tkhd_size, mdhd_size, minf_size, stbl_size, box_size;
+    
+    const uint8_t *mdia = find_box(trak, trak_size, BOX_TYPE('m', 'd', 'i', 'a'), &mdia_size);
+    const uint8_t *hdlr = find_box(mdia, mdia_size, BOX_TYPE('h', 'd', 'l', 'r'), &hdlr_size);
+    if (!hdlr || hdlr_size < 12 || read_u32(hdlr + 8) != BOX_TYPE('v', 'i', 'd', 'e')) {
         return false;
     }
     
-    const char *stream_name_start = mp4_pos + 5; // Skip "/mp4/"
-    const char *stream_name_end = strchr(stream_name_start, '/');
-    if (!stream_name_end) {
-        log_error("Invalid recording path format: %s", file_path);
+    // Presentation size, 16.16 fixed point
+    uint32_t track_id = 0;
+    const uint8_t *tkhd = find_box(trak, trak_size, BOX_TYPE('t', 'k', 'h', 'd'), &tkhd_size);
+    if (tkhd && tkhd[0] == 1 && tkhd_size >= 96) {
+        track_id = read_u32(tkhd + 20);
+        info->width = (int)(read_u32(tkhd + 88) >> 16);
+        info->height = (int)(read_u32(tkhd + 92) >> 16);
+    } else if (tkhd && tkhd[0] == 0 && tkhd_size >= 84) {
+        track_id = read_u32(tkhd + 12);
+        info->width = (int)(read_u32(tkhd + 76) >> 16);
+        info->height = (int)(read_u32(tkhd + 80) >> 16);
+    }
+    
+    const uint8_t *minf = find_box(mdia, mdia_size, BOX_TYPE('m', 'i', 'n', 'f'), &minf_size);
+    const uint8_t *stbl = find_box(minf, minf_size, BOX_TYPE('s', 't', 'b', 'l'), &stbl_size);
+    
+    // First sample description: codec, and coded size if tkhd had none
+    const uint8_t *stsd = find_box(stbl, stbl_size, BOX_TYPE('s', 't', 's', 'd'), &box_size);
+    if (stsd && box_size >= 16 && read_u32(stsd + 4) > 0) {
+        const uint8_t *entry = stsd + 8;
+        strncpy(info->codec, sample_entry_codec(read_u32(entry + 4)), sizeof(info->codec) - 1);
+        if ((info->width == 0 || info->height == 0) && box_size >= 8 + 36) {
+            info->width = (entry[32] << 8) | entry[33];
+            info->height = (entry[34] << 8) | entry[35];
+        }
+    }
+    
+    // Frame rate from the sample count, or the fragment default sample duration
+    uint32_t timescale = 0;
+    uint64_t duration = 0;
+    const uint8_t *mdhd = find_box(mdia, mdia_size, BOX_TYPE('m', 'd', 'h', 'd'), &mdhd_size);
+    if (read_box_duration(mdhd, mdhd_size, &timescale, &duration) && timescale > 0) {
+        const uint8_t *stts = find_box(stbl, stbl_size, BOX_TYPE('s', 't', 't', 's'), &box_size);
+        uint64_t samples = 0;
+        if (stts && box_size >= 8) {
+            uint32_t entries = read_u32(stts + 4);
+            for (uint32_t i = 0; i < entries && 8 + (size_t)i * 8 + 8 <= box_size; i++) {
+                samples += read_u32(stts + 8 + (size_t)i * 8);
+            }
+        }
+        
+        if (samples > 0 && duration > 0) {
+            info->fps = (int)((samples * timescale + duration / 2) / duration);
+        } else if (mvex) {
+            size_t pos = 0;
+            const uint8_t *trex;
+            while ((trex = next_box(mvex, mvex_size, &pos, BOX_TYPE('t', 'r', 'e', 'x'), &box_size))) {
+                if (box_size >= 16 && read_u32(trex + 4) == track_id && read_u32(trex + 12) > 0) {
+                    info->fps = (int)((timescale + read_u32(trex + 12) / 2) / read_u32(trex + 12));
+                    break;
+                }
+            }
+        }
+    }
+    
+    return true;
+}
+
+/**
+ * Read duration and video properties from the MP4 box headers
+ * 
+ * @param file_path Path to the recording file
+ * @param st File status
+ * @param info Pointer to recording_file_info_t structure to fill
+ * @param duration_s Receives the duration in seconds
+ * @return true if a duration and a video track were found, false otherwise
+ */
+static bool parse_mp4_info(const char *file_path, const struct stat *st,
+                           recording_file_info_t *info, int64_t *duration_s) {
+    int fd = open(file_path, O_RDONLY);
+    if (fd < 0) {
         return false;
     }
     
-    size_t stream_name_len = stream_name_end - stream_name_start;
-    if (stream_name_len >= MAX_STREAM_NAME) {
-        stream_name_len = MAX_STREAM_NAME - 1;
+    size_t moov_size = 0;
+    uint8_t *moov = read_moov(fd, (uint64_t)st->st_size, &moov_size);
+    close(fd);
+    if (!moov) {
+        return false;
     }
-    strncpy(info->stream_name, stream_name_start, stream_name_len);
-    info->stream_name[stream_name_len] = '\0';
     
-    // Get file size
-    if (stat(file_path, &st) == 0) {
-        info->size_bytes = st.st_size;
-    } else {
-        log_error("Failed to get file size: %s", file_path);
+    size_t mvhd_size, mvex_size = 0, box_size;
+    uint32_t timescale = 0;
+    uint64_t duration = 0;
+    
+    const uint8_t *mvhd = find_box(moov, moov_size, BOX_TYPE('m', 'v', 'h', 'd'), &mvhd_size);
+    const uint8_t *mvex = find_box(moov, moov_size, BOX_TYPE('m', 'v', 'e', 'x'), &mvex_size);
+    bool valid = read_box_duration(mvhd, mvhd_size, &timescale, &duration) && timescale > 0;
+    
+    // Fragmented files carry their duration in mehd, if at all
+    if (valid && duration == 0 && mvex) {
+        const uint8_t *mehd = find_box(mvex, mvex_size, BOX_TYPE('m', 'e', 'h', 'd'), &box_size);
+        if (mehd && mehd[0] == 1 && box_size >= 12) {
+            duration = read_u64(mehd + 4);
+        } else if (mehd && box_size >= 8) {
+            duration = read_u32(mehd + 4);
+        }
+    }
+    valid = valid && duration > 0;
+    
+    bool found_video = false;
+    size_t pos = 0, trak_size;
+    const uint8_t *trak;
+    while (valid && !found_video &&
+           (trak = next_box(moov, moov_size, &pos, BOX_TYPE('t', 'r', 'a', 'k'), &trak_size))) {
+        found_video = parse_video_track(trak, trak_size, mvex, mvex_size, info);
+    }
+    
+    free(moov);
+    
+    if (!valid || !found_video) {
         return false;
     }
     
+    *duration_s = (int64_t)(duration / timescale);
+    return true;
+}
+
+/**
+ * Read duration and video properties with FFmpeg
+ * Used for files whose box headers do not give them, e.g. fragmented files
+ * without a movie extends header.
+ * 
+ * @param file_path Path to the recording file
+ * @param info Pointer to recording_file_info_t structure to fill
+ * @param duration_s Receives the duration in seconds, -1 if unknown
+ * @return true if a video stream was found, false otherwise
+ */
+static bool probe_recording_info(const char *file_path, recording_file_info_t *info, int64_t *duration_s) {
+    AVFormatContext *format_ctx = NULL;
+    AVCodecParameters *codec_params = NULL;
+    int video_stream_index = -1;
+    
     // Open the file with FFmpeg
     if (avformat_open_input(&format_ctx, file_path, NULL, NULL) != 0) {
         log_error("Failed to open file: %s", file_path);
@@ -241,9 +638,9 @@ static bool extract_recording_info(const char *file_path, recording_file_info_t
     }
     
     // Find the first video stream
-    for (i = 0; i < format_ctx->nb_streams; i++) {
+    for (unsigned int i = 0; i < format_ctx->nb_streams; i++) {
         if (format_ctx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
-            video_stream_index = i;
+            video_stream_index = (int)i;
             break;
         }
     }
@@ -263,215 +660,451 @@ static bool extract_recording_info(const char *file_path, recording_file_info_t
     
     // Get codec name
     const AVCodecDescriptor *codec_desc = avcodec_descriptor_get(codec_params->codec_id);
-    if (codec_desc) {
-        strncpy(info->codec, codec_desc->name, sizeof(info->codec) - 1);
-    } else {
-        strncpy(info->codec, "unknown", sizeof(info->codec) - 1);
-    }
+    strncpy(info->codec, codec_desc ? codec_desc->name : "unknown", sizeof(info->codec) - 1);
     
     // Calculate FPS
     AVRational frame_rate = format_ctx->streams[video_stream_index]->avg_frame_rate;
     if (frame_rate.den != 0) {
         info->fps = frame_rate.num / frame_rate.den;
-    } else {
+    }
+    
+    // Duration is in AV_TIME_BASE units (microseconds)
+    *duration_s = format_ctx->duration != AV_NOPTS_VALUE ? format_ctx->duration / AV_TIME_BASE : -1;
+    
+    avformat_close_input(&format_ctx);
+    return true;
+}
+
+/**
+ * Extract recording information from a file
+ * 
+ * @param file_path Path to the recording file
+ * @param st File status
+ * @param info Pointer to recording_file_info_t structure to fill
+ * @return true if information was extracted successfully, false otherwise
+ */
+static bool extract_recording_info(const char *file_path, const struct stat *st, recording_file_info_t *info) {
+    // Initialize info structure
+    memset(info, 0, sizeof(recording_file_info_t));
+    strncpy(info->path, file_path, MAX_PATH_LENGTH - 1);
+    
+    // Extract stream name from path
+    // Assuming path format: /storage_path/mp4/stream_name/recording.mp4
+    const char *mp4_pos = strstr(file_path, "/mp4/");
+    if (!mp4_pos) {
+        log_error("Invalid recording path format: %s", file_path);
+        return false;
+    }
+    
+    const char *stream_name_start = mp4_pos + 5; // Skip "/mp4/"
+    const char *stream_name_end = strchr(stream_name_start, '/');
+    if (!stream_name_end) {
+        log_error("Invalid recording path format: %s", file_path);
+        return false;
+    }
+    
+    size_t stream_name_len = stream_name_end - stream_name_start;
+    if (stream_name_len >= MAX_STREAM_NAME) {
+        stream_name_len = MAX_STREAM_NAME - 1;
+    }
+    strncpy(info->stream_name, stream_name_start, stream_name_len);
+    info->stream_name[stream_name_len] = '\0';
+    
+    info->size_bytes = st->st_size;
+    
+    int64_t duration_s = -1;
+    if (!parse_mp4_info(file_path, st, info, &duration_s)) {
+        memset(info->codec, 0, sizeof(info->codec));
+        info->width = info->height = info->fps = 0;
+        if (!probe_recording_info(file_path, info, &duration_s)) {
+            return false;
+        }
+    }
+    
+    if (info->fps <= 0) {
         info->fps = 30; // Default to 30 fps if not available
     }
     
-    // Get start and end times
-    if (format_ctx->duration != AV_NOPTS_VALUE) {
-        // Duration is in AV_TIME_BASE units (microseconds)
-        int64_t duration_us = format_ctx->duration;
-        int64_t duration_s = duration_us / AV_TIME_BASE;
-        
-        // Use file modification time as the end time
-        info->end_time = st.st_mtime;
-        
+    // Use file modification time as the end time
+    info->end_time = st->st_mtime;
+    
+    if (duration_s >= 0) {
         // Calculate start time by subtracting duration from end time
         info->start_time = info->end_time - duration_s;
-        
-        log_info("Using file modification time for recording: %s (start: %ld, end: %ld, duration: %ld)",
-                file_path, info->start_time, info->end_time, duration_s);
+        log_debug("Using file modification time for recording: %s (start: %ld, end: %ld, duration: %ld)",
+                  file_path, info->start_time, info->end_time, (long)duration_s);
     } else {
-        // If duration is not available, use file modification time and assume 1 minute duration
-        info->end_time = st.st_mtime;
         info->start_time = info->end_time - 30; // Assume 30 second duration
-        
         log_warn("Duration not available for recording: %s, assuming 30 seconds", file_path);
     }
     
-    avformat_close_input(&format_ctx);
     return true;
 }
 
 /**
- * Add a recording to the database
- * 
- * @param info Recording information
- * @return true if the recording was added successfully, false otherwise
+ * Queue a scanned recording for the database thread
  */
-static bool add_recording_to_db(const recording_file_info_t *info) {
-    recording_metadata_t metadata;
-    uint64_t recording_id;
-    
-    // Fill in metadata
-    memset(&metadata, 0, sizeof(recording_metadata_t));
-    strncpy(metadata.stream_name, info->stream_name, sizeof(metadata.stream_name) - 1);
-    strncpy(metadata.file_path, info->path, sizeof(metadata.file_path) - 1);
-    metadata.start_time = info->start_time;
-    metadata.end_time = info->end_time;
-    metadata.size_bytes = info->size_bytes;
-    metadata.width = info->width;
-    metadata.height = info->height;
-    metadata.fps = info->fps;
-    strncpy(metadata.codec, info->codec, sizeof(metadata.codec) - 1);
-    metadata.is_complete = true;
-    
-    // Add to database
-    recording_id = add_recording_metadata(&metadata);
-    if (recording_id == 0) {
-        log_error("Failed to add recording metadata for %s", info->path);
-        return false;
+static void queue_recording(scan_state_t *state, const recording_file_info_t *info) {
+    pthread_mutex_lock(&state->mutex);
+    while (state->queue_count == RESULT_QUEUE_SIZE) {
+        pthread_cond_wait(&state->not_full, &state->mutex);
     }
     
-    log_info("Added recording: %s (stream: %s, start: %ld, end: %ld)",
-             info->path, info->stream_name, info->start_time, info->end_time);
-    
-    return true;
+    state->queue[(state->queue_head + state->queue_count) % RESULT_QUEUE_SIZE] = *info;
+    state->queue_count++;
+    pthread_cond_signal(&state->not_empty);
+    pthread_mutex_unlock(&state->mutex);
 }
 
 /**
- * Process a recording file
+ * Take the next scanned recording
  * 
- * @param file_path Path to the recording file
- * @return true if the file was processed successfully, false otherwise
+ * @return true if a recording was taken, false once all workers are done
  */
-static bool process_recording_file(const char *file_path) {
-    recording_file_info_t info;
-    bool is_disabled;
-    
-    // Check if the recording already exists in the database
-    if (recording_exists_in_db(file_path)) {
-        log_debug("Recording already exists in database: %s", file_path);
-        return true;
+static bool dequeue_recording(scan_state_t *state, recording_file_info_t *info) {
+    pthread_mutex_lock(&state->mutex);
+    while (state->queue_count == 0 && state->active_workers > 0) {
+        pthread_cond_wait(&state->not_empty, &state->mutex);
     }
     
-    // Extract recording information
-    if (!extract_recording_info(file_path, &info)) {
-        log_error("Failed to extract recording information: %s", file_path);
-        return false;
-    }
-    
-    // Check if the stream exists
-    if (!stream_exists_in_db(info.stream_name, &is_disabled)) {
-        // Stream doesn't exist, create a disabled stream
-        if (!create_disabled_stream(info.stream_name)) {
-            log_error("Failed to create disabled stream: %s", info.stream_name);
-            return false;
-        }
-    } else if (is_disabled) {
-        log_info("Stream %s already exists as disabled", info.stream_name);
-    } else {
-        log_info("Stream %s already exists", info.stream_name);
-    }
-    
-    // Add the recording to the database
-    if (!add_recording_to_db(&info)) {
-        log_error("Failed to add recording to database: %s", file_path);
+    if (state->queue_count == 0) {
+        pthread_mutex_unlock(&state->mutex);
         return false;
     }
     
+    *info = state->queue[state->queue_head];
+    state->queue_head = (state->queue_head + 1) % RESULT_QUEUE_SIZE;
+    state->queue_count--;
+    pthread_cond_signal(&state->not_full);
+    pthread_mutex_unlock(&state->mutex);
     return true;
 }
 
-// Forward declarations
-static bool process_directory(const char *dir_path, int *processed_count, int *added_count);
-
 /**
  * Process MP4 files in a directory (non-recursive)
+ * Files already in the database are skipped; the others are parsed and
+ * queued for the database thread.
  * 
+ * @param state Scan state
  * @param dir_path Path to the directory
- * @param processed_count Pointer to counter for processed files
- * @param added_count Pointer to counter for added files
- * @return true if the directory was processed successfully, false otherwise
  */
-static bool process_directory(const char *dir_path, int *processed_count, int *added_count) {
+static void process_directory(scan_state_t *state, const char *dir_path) {
     DIR *dir;
     struct dirent *entry;
     char file_path[MAX_PATH_LENGTH];
     struct stat st;
-    int initial_added_count = *added_count;
+    recording_file_info_t info;
     
     dir = opendir(dir_path);
     if (!dir) {
         log_error("Failed to open directory: %s (error: %s)", dir_path, strerror(errno));
-        return false;
+        return;
     }
     
     while ((entry = readdir(dir)) != NULL) {
-        // Skip . and ..
-        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+        // Only MP4 files, checked by name before touching the inode
+        const char *ext = strrchr(entry->d_name, '.');
+        if (!ext || strcasecmp(ext, ".mp4") != 0) {
             continue;
         }
         
         // Construct full path
         snprintf(file_path, sizeof(file_path), "%s/%s", dir_path, entry->d_name);
         
-        // Get file/directory info
+        // Get file info
         if (stat(file_path, &st) != 0) {
             log_error("Failed to stat file: %s (error: %s)", file_path, strerror(errno));
             continue;
         }
         
         // Only process regular files
-        if (S_ISREG(st.st_mode)) {
-            // Check if it's an MP4 file
-            const char *ext = strrchr(entry->d_name, '.');
-            if (ext && strcasecmp(ext, ".mp4") == 0) {
-                (*processed_count)++;
-                
-                // Process the recording file
-                if (process_recording_file(file_path)) {
-                    (*added_count)++;
-                }
-                
-                // Print progress every 10 files
-                if (*processed_count % 10 == 0) {
-                    printf("Processed %d files, added %d recordings\n", *processed_count, *added_count);
-                }
-            }
+        if (!S_ISREG(st.st_mode)) {
+            continue;
+        }
+        
+        pthread_mutex_lock(&state->mutex);
+        state->processed_count++;
+        pthread_mutex_unlock(&state->mutex);
+        
+        // The set is only read while workers run
+        if (string_set_contains(state->known_paths, file_path)) {
+            continue;
+        }
+        
+        if (!extract_recording_info(file_path, &st, &info)) {
+            log_error("Failed to extract recording information: %s", file_path);
+            pthread_mutex_lock(&state->mutex);
+            state->failed_count++;
+            pthread_mutex_unlock(&state->mutex);
+            continue;
         }
+        
+        queue_recording(state, &info);
     }
     
     closedir(dir);
+}
+
+/**
+ * Scan directories until none are left
+ */
+static void *scan_worker(void *arg) {
+    scan_state_t *state = (scan_state_t *)arg;
+    
+    for (;;) {
+        pthread_mutex_lock(&state->mutex);
+        if (state->next_dir >= state->dir_count) {
+            state->active_workers--;
+            pthread_cond_broadcast(&state->not_empty);
+            pthread_mutex_unlock(&state->mutex);
+            break;
+        }
+        int index = state->next_dir++;
+        pthread_mutex_unlock(&state->mutex);
+        
+        process_directory(state, state->dirs[index]);
+    }
     
-    // Print summary for this directory if files were added
-    if (*added_count > initial_added_count) {
-        printf("Added %d recordings from %s\n", *added_count - initial_added_count, dir_path);
+    return NULL;
+}
+
+/**
+ * Make sure the stream of a recording exists, creating it disabled if not
+ * 
+ * @param stream_name Name of the stream
+ * @return true if the stream exists or was created, false otherwise
+ */
+static bool ensure_stream(const char *stream_name) {
+    bool is_disabled;
+    
+    // Check if the stream exists
+    if (!stream_exists_in_db(stream_name, &is_disabled)) {
+        // Stream doesn't exist, create a disabled stream
+        if (!create_disabled_stream(stream_name)) {
+            log_error("Failed to create disabled stream: %s", stream_name);
+            return false;
+        }
+    } else if (is_disabled) {
+        log_info("Stream %s already exists as disabled", stream_name);
+    } else {
+        log_info("Stream %s already exists", stream_name);
     }
     
     return true;
 }
 
 /**
- * Scan a directory and its subdirectories for MP4 files
+ * Add a batch of recordings to the database
+ * If the batch fails as a whole, its recordings are added one by one so a
+ * single bad row does not lose the others.
  * 
- * @param base_dir Path to the base directory
- * @param processed_count Pointer to counter for processed files
- * @param added_count Pointer to counter for added files
+ * @return Number of recordings added
+ */
+static int add_recordings_to_db(const recording_metadata_t *batch, int count) {
+    if (count == 0) {
+        return 0;
+    }
+    
+    int added = add_recording_metadata_batch(batch, count);
+    if (added >= 0) {
+        return added;
+    }
+    
+    added = 0;
+    for (int i = 0; i < count; i++) {
+        if (add_recording_metadata(&batch[i]) != 0) {
+            added++;
+        } else {
+            log_error("Failed to add recording metadata for %s", batch[i].file_path);
+        }
+    }
+    return added;
+}
+
+/**
+ * Scan directories with a pool of threads and add missing recordings
+ * Threads claim whole directories; this thread owns the database and
+ * adds what they find in batches.
+ * 
+ * @param state Scan state with the directories to scan
+ * @param added_count Receives the number of recordings added
  * @return true if the scan was successful, false otherwise
  */
-static bool scan_directory(const char *base_dir, int *processed_count, int *added_count) {
+static bool scan_directories(scan_state_t *state, int *added_count) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int thread_count = cpus > 0 ? (int)cpus : 1;
+    if (thread_count > MAX_SCAN_THREADS) {
+        thread_count = MAX_SCAN_THREADS;
+    }
+    if (thread_count > state->dir_count) {
+        thread_count = state->dir_count;
+    }
+    
+    pthread_t threads[MAX_SCAN_THREADS];
+    int started = 0;
+    state->active_workers = thread_count;
+    for (int i = 0; i < thread_count; i++) {
+        if (pthread_create(&threads[i], NULL, scan_worker, state) != 0) {
+            log_error("Failed to create scan thread");
+            pthread_mutex_lock(&state->mutex);
+            state->active_workers -= thread_count - i;
+            pthread_mutex_unlock(&state->mutex);
+            break;
+        }
+        started++;
+    }
+    
+    if (started == 0) {
+        return false;
+    }
+    
+    printf("Scanning %d directories with %d threads\n", state->dir_count, started);
+    
+    recording_metadata_t *batch = malloc(INSERT_BATCH_SIZE * sizeof(recording_metadata_t));
+    string_set_t streams = {0};
+    recording_file_info_t info;
+    int batch_count = 0;
+    int last_report = 0;
+    bool success = batch != NULL;
+    
+    if (!batch) {
+        log_error("Failed to allocate memory for recording metadata");
+    }
+    
+    // Keep draining the queue even on failure so the workers can finish
+    while (dequeue_recording(state, &info)) {
+        if (!success) {
+            continue;
+        }
+        
+        // Each stream is looked up once
+        if (!string_set_contains(&streams, info.stream_name)) {
+            if (!ensure_stream(info.stream_name)) {
+                continue;
+            }
+            string_set_add(&streams, info.stream_name);
+        }
+        
+        recording_metadata_t *metadata = &batch[batch_count++];
+        memset(metadata, 0, sizeof(recording_metadata_t));
+        strncpy(metadata->stream_name, info.stream_name, sizeof(metadata->stream_name) - 1);
+        strncpy(metadata->file_path, info.path, sizeof(metadata->file_path) - 1);
+        metadata->start_time = info.start_time;
+        metadata->end_time = info.end_time;
+        metadata->size_bytes = info.size_bytes;
+        metadata->width = info.width;
+        metadata->height = info.height;
+        metadata->fps = info.fps;
+        strncpy(metadata->codec, info.codec, sizeof(metadata->codec) - 1);
+        metadata->is_complete = true;
+        
+        if (batch_count == INSERT_BATCH_SIZE) {
+            *added_count += add_recordings_to_db(batch, batch_count);
+            batch_count = 0;
+            
+            pthread_mutex_lock(&state->mutex);
+            int processed = state->processed_count;
+            pthread_mutex_unlock(&state->mutex);
+            if (processed - last_report >= 10000) {
+                printf("Processed %d files, added %d recordings\n", processed, *added_count);
+                last_report = processed;
+            }
+        }
+    }
+    
+    if (success) {
+        *added_count += add_recordings_to_db(batch, batch_count);
+    }
+    
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    
+    string_set_free(&streams);
+    free(batch);
+    return success;
+}
+
+/**
+ * Add a directory to the scan, and its shard directories below depth levels
+ * 
+ * @return true on success, false otherwise
+ */
+static bool add_directory(scan_state_t *state, int *capacity, const char *path, int depth) {
+    if (state->dir_count == *capacity) {
+        *capacity *= 2;
+        void *dirs = realloc(state->dirs, *capacity * sizeof(*state->dirs));
+        if (!dirs) {
+            log_error("Failed to allocate memory for directory list");
+            return false;
+        }
+        state->dirs = dirs;
+    }
+    
+    strncpy(state->dirs[state->dir_count], path, MAX_PATH_LENGTH - 1);
+    state->dirs[state->dir_count][MAX_PATH_LENGTH - 1] = '\0';
+    state->dir_count++;
+    
+    if (depth <= 0) {
+        return true;
+    }
+    
+    DIR *dir = opendir(path);
+    if (!dir) {
+        return true;
+    }
+    
+    bool success = true;
+    struct dirent *entry;
+    while (success && (entry = readdir(dir)) != NULL) {
+        // Only year, month, day and hour directories, not segmented recordings
+        if (!recording_layout_is_shard_name(entry->d_name)) {
+            continue;
+        }
+        
+        char sub_path[MAX_PATH_LENGTH];
+        struct stat st;
+        snprintf(sub_path, sizeof(sub_path), "%s/%s", path, entry->d_name);
+        if (entry->d_type != DT_DIR) {
+            if (entry->d_type != DT_UNKNOWN || stat(sub_path, &st) != 0 || !S_ISDIR(st.st_mode)) {
+                continue;
+            }
+        }
+        
+        success = add_directory(state, capacity, sub_path, depth - 1);
+    }
+    
+    closedir(dir);
+    return success;
+}
+
+/**
+ * Collect a directory and its subdirectories for scanning
+ * Stream directories are collected with their shard directories, so the
+ * recordings of each hour are scanned as a directory of their own.
+ * 
+ * @param base_dir Path to the base directory
+ * @param state Scan state to add the directories to
+ * @return true on success, false otherwise
+ */
+static bool collect_directories(const char *base_dir, scan_state_t *state) {
     DIR *dir;
     struct dirent *entry;
     char path[MAX_PATH_LENGTH];
     struct stat st;
+    int capacity = 64;
     
-    // Process files in the base directory
-    if (!process_directory(base_dir, processed_count, added_count)) {
+    state->dirs = malloc(capacity * sizeof(*state->dirs));
+    if (!state->dirs) {
+        log_error("Failed to allocate memory for directory list");
         return false;
     }
     
-    // Find and process subdirectories
+    // The base directory itself comes first
+    strncpy(state->dirs[0], base_dir, MAX_PATH_LENGTH - 1);
+    state->dirs[0][MAX_PATH_LENGTH - 1] = '\0';
+    state->dir_count = 1;
+    
     dir = opendir(base_dir);
     if (!dir) {
         log_error("Failed to open directory: %s (error: %s)", base_dir, strerror(errno));
@@ -487,16 +1120,16 @@ static bool scan_directory(const char *base_dir, int *processed_count, int *adde
         // Construct full path
         snprintf(path, sizeof(path), "%s/%s", base_dir, entry->d_name);
         
-        // Get file/directory info
-        if (stat(path, &st) != 0) {
-            log_error("Failed to stat file: %s (error: %s)", path, strerror(errno));
-            continue;
+        // Trust d_type where the filesystem provides it
+        if (entry->d_type != DT_DIR) {
+            if (entry->d_type != DT_UNKNOWN || stat(path, &st) != 0 || !S_ISDIR(st.st_mode)) {
+                continue;
+            }
         }
         
-        // Process subdirectories
-        if (S_ISDIR(st.st_mode)) {
-            printf("Scanning subdirectory: %s\n", path);
-            process_directory(path, processed_count, added_count);
+        if (!add_directory(state, &capacity, path, RECORDING_SHARD_DEPTH)) {
+            closedir(dir);
+            return false;
         }
     }
     
@@ -504,14 +1137,230 @@ static bool scan_directory(const char *base_dir, int *processed_count, int *adde
     return true;
 }
 
+/**
+ * Get the start time encoded in a recording name, recording_YYYYmmdd_HHMMSS
+ * 
+ * @return Start time, or 0 if the name has none
+ */
+static time_t recording_name_time(const char *name) {
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    if (sscanf(name, "recording_%4d%2d%2d_%2d%2d%2d", &tm.tm_year, &tm.tm_mon, &tm.tm_mday,
+               &tm.tm_hour, &tm.tm_min, &tm.tm_sec) != 6) {
+        return 0;
+    }
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+    tm.tm_isdst = -1;
+    return mktime(&tm);
+}
+
+/**
+ * Move a file or directory of a stream directory into its shard directory
+ * The hour comes from the name where it has one, so a recording and the
+ * files next to it (thumbnails, key frame index) end up together.
+ * 
+ * @param stream_dir Directory of the stream
+ * @param name Name of the entry in stream_dir
+ * @param start_time Start time to use if the name has none
+ * @param new_path Receives the new path of the entry
+ * @return 0 on success, -1 on error
+ */
+static int move_to_shard(const char *stream_dir, const char *name, time_t start_time,
+                         char *new_path, size_t size) {
+    time_t t = recording_name_time(name);
+    if (t == 0) {
+        t = start_time;
+    }
+    
+    char shard[MAX_PATH_LENGTH];
+    char old_path[MAX_PATH_LENGTH];
+    snprintf(old_path, sizeof(old_path), "%s/%s", stream_dir, name);
+    if (recording_layout_shard_dir(stream_dir, t, shard, sizeof(shard)) != 0 ||
+        snprintf(new_path, size, "%s/%s", shard, name) >= (int)size) {
+        log_error("Sharded path of %s is too long", old_path);
+        return -1;
+    }
+    if (recording_layout_make_dirs(shard) != 0) {
+        return -1;
+    }
+    if (access(new_path, F_OK) == 0) {
+        log_error("Not moving %s, %s already exists", old_path, new_path);
+        return -1;
+    }
+    if (rename(old_path, new_path) != 0) {
+        log_error("Failed to move %s to %s: %s", old_path, new_path, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+// Recording still to be moved by migrate_layout
+typedef struct {
+    uint64_t id;
+    char file_path[MAX_PATH_LENGTH];
+    time_t start_time;
+} layout_move_t;
+
+/**
+ * Move the files left next to moved recordings into the same shard directories
+ */
+static void migrate_sidecar_files(const char *stream_dir) {
+    DIR *dir = opendir(stream_dir);
+    if (!dir) {
+        return;
+    }
+    
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        const char *dot = strchr(entry->d_name, '.');
+        if (!dot || recording_name_time(entry->d_name) == 0 || entry->d_type == DT_DIR) {
+            continue;
+        }
+        
+        // Only files of recordings that are no longer here, so nothing of an unmoved one
+        char recording_path[MAX_PATH_LENGTH];
+        snprintf(recording_path, sizeof(recording_path), "%s/%.*s.mp4", stream_dir,
+                 (int)(dot - entry->d_name), entry->d_name);
+        if (strcasecmp(dot, ".mp4") == 0 || access(recording_path, F_OK) == 0) {
+            continue;
+        }
+        
+        char new_path[MAX_PATH_LENGTH];
+        move_to_shard(stream_dir, entry->d_name, 0, new_path, sizeof(new_path));
+    }
+    
+    closedir(dir);
+}
+
+/**
+ * Move the recordings below mp4_path that are still directly in their stream
+ * directory into the sharded layout
+ * 
+ * @param mp4_path Directory of the stream directories
+ * @param moved_count Receives the number of recordings moved
+ * @return 0 on success, -1 on error
+ */
+static int migrate_layout(const char *mp4_path, int *moved_count) {
+    sqlite3 *db = get_db_handle();
+    pthread_mutex_t *db_mutex = get_db_mutex();
+    if (!db) {
+        log_error("Database not initialized");
+        return -1;
+    }
+    
+    // Read the whole list first; paths change while recordings are moved
+    layout_move_t *moves = NULL;
+    int count = 0;
+    int capacity = 0;
+    size_t base_len = strlen(mp4_path);
+    
+    lock_db_mutex();
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, "SELECT id, file_path, start_time FROM recordings;", -1, &stmt, NULL) != SQLITE_OK) {
+        log_error("Failed to prepare statement: %s", sqlite3_errmsg(db));
+        pthread_mutex_unlock(db_mutex);
+        return -1;
+    }
+    
+    int result = 0;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const char *path = (const char *)sqlite3_column_text(stmt, 1);
+        if (!path || strncmp(path, mp4_path, base_len) != 0 || path[base_len] != '/' ||
+            recording_layout_is_sharded(path)) {
+            continue;
+        }
+        
+        if (count == capacity) {
+            capacity = capacity == 0 ? 1024 : capacity * 2;
+            layout_move_t *grown = realloc(moves, capacity * sizeof(layout_move_t));
+            if (!grown) {
+                log_error("Failed to allocate memory for recordings to move");
+                result = -1;
+                break;
+            }
+            moves = grown;
+        }
+        
+        moves[count].id = (uint64_t)sqlite3_column_int64(stmt, 0);
+        strncpy(moves[count].file_path, path, MAX_PATH_LENGTH - 1);
+        moves[count].file_path[MAX_PATH_LENGTH - 1] = '\0';
+        moves[count].start_time = (time_t)sqlite3_column_int64(stmt, 2);
+        count++;
+    }
+    sqlite3_finalize(stmt);
+    pthread_mutex_unlock(db_mutex);
+    
+    printf("Moving %d recordings into the sharded layout\n", result == 0 ? count : 0);
+    
+    char last_stream_dir[MAX_PATH_LENGTH] = "";
+    for (int i = 0; result == 0 && i < count; i++) {
+        // <stream>/<file>, or <stream>/<recording dir>/<playlist> for segmented recordings
+        const char *rest = moves[i].file_path + base_len + 1;
+        const char *first_slash = strchr(rest, '/');
+        if (!first_slash) {
+            continue;
+        }
+        const char *second_slash = strchr(first_slash + 1, '/');
+        if (second_slash && (strchr(second_slash + 1, '/') ||
+                             strncmp(first_slash + 1, "recording_", strlen("recording_")) != 0)) {
+            continue;
+        }
+        
+        char stream_dir[MAX_PATH_LENGTH];
+        char name[MAX_PATH_LENGTH];
+        snprintf(stream_dir, sizeof(stream_dir), "%.*s", (int)(first_slash - moves[i].file_path),
+                 moves[i].file_path);
+        if (second_slash) {
+            snprintf(name, sizeof(name), "%.*s", (int)(second_slash - first_slash - 1), first_slash + 1);
+        } else {
+            snprintf(name, sizeof(name), "%s", first_slash + 1);
+        }
+        
+        char new_entry[MAX_PATH_LENGTH];
+        if (move_to_shard(stream_dir, name, moves[i].start_time, new_entry, sizeof(new_entry)) != 0) {
+            continue;
+        }
+        
+        char new_path[MAX_PATH_LENGTH];
+        snprintf(new_path, sizeof(new_path), "%s%s", new_entry, second_slash ? second_slash : "");
+        if (move_recording_file_path(moves[i].id, moves[i].file_path, new_path) != 0) {
+            // Put it back so the database still points at it
+            log_error("Failed to update the path of recording %llu, leaving %s in place",
+                      (unsigned long long)moves[i].id, moves[i].file_path);
+            char old_entry[MAX_PATH_LENGTH];
+            snprintf(old_entry, sizeof(old_entry), "%s/%s", stream_dir, name);
+            rename(new_entry, old_entry);
+            continue;
+        }
+        (*moved_count)++;
+        
+        if (strcmp(stream_dir, last_stream_dir) != 0) {
+            if (last_stream_dir[0] != '\0') {
+                migrate_sidecar_files(last_stream_dir);
+            }
+            strncpy(last_stream_dir, stream_dir, sizeof(last_stream_dir) - 1);
+        }
+        if (*moved_count % 10000 == 0) {
+            printf("Moved %d recordings\n", *moved_count);
+        }
+    }
+    if (last_stream_dir[0] != '\0') {
+        migrate_sidecar_files(last_stream_dir);
+    }
+    
+    free(moves);
+    return result;
+}
+
 /**
  * Main function
  */
 int main(int argc, char *argv[]) {
     char storage_path[MAX_PATH_LENGTH];
     char mp4_path[MAX_PATH_LENGTH];
-    int processed_count = 0;
     int added_count = 0;
+    bool migrate = false;
     
     // Initialize logging
     init_logger();
@@ -524,11 +1373,14 @@ int main(int argc, char *argv[]) {
     }
     
     // Parse command line arguments
-    if (argc > 1) {
-        strncpy(storage_path, argv[1], sizeof(storage_path) - 1);
-    } else {
-        // Use storage path from config
-        strncpy(storage_path, config.storage_path, sizeof(storage_path) - 1);
+    // Use storage path from config unless one is given
+    strncpy(storage_path, config.storage_path, sizeof(storage_path) - 1);
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--migrate-layout") == 0) {
+            migrate = true;
+        } else {
+            strncpy(storage_path, argv[i], sizeof(storage_path) - 1);
+        }
     }
     
     printf("Using storage path: %s\n", storage_path);
@@ -553,17 +1405,57 @@ int main(int argc, char *argv[]) {
         return 1;
     }
     
-    printf("Scanning for recordings in %s\n", mp4_path);
+    // Recordings already in the database, looked up in memory while scanning
+    string_set_t known_paths = {0};
+    if (load_recording_paths(&known_paths) != 0) {
+        string_set_free(&known_paths);
+        shutdown_database();
+        return 1;
+    }
+    
+    printf("Scanning for recordings in %s (%zu already in the database)\n", mp4_path, known_paths.count);
+    
+    scan_state_t state;
+    memset(&state, 0, sizeof(state));
+    state.known_paths = &known_paths;
+    state.queue = malloc(RESULT_QUEUE_SIZE * sizeof(recording_file_info_t));
+    pthread_mutex_init(&state.mutex, NULL);
+    pthread_cond_init(&state.not_empty, NULL);
+    pthread_cond_init(&state.not_full, NULL);
+    
+    // Scan the MP4 directory and its stream directories
+    bool success = state.queue && collect_directories(mp4_path, &state) &&
+                   scan_directories(&state, &added_count);
+    
+    pthread_cond_destroy(&state.not_full);
+    pthread_cond_destroy(&state.not_empty);
+    pthread_mutex_destroy(&state.mutex);
+    free(state.queue);
+    free(state.dirs);
+    string_set_free(&known_paths);
     
-    // Scan the MP4 directory
-    if (!scan_directory(mp4_path, &processed_count, &added_count)) {
+    if (!success) {
         log_error("Failed to scan directory: %s", mp4_path);
         shutdown_database();
         return 1;
     }
     
-    printf("Scan complete. Processed %d files, added %d recordings to the database.\n",
-           processed_count, added_count);
+    printf("Scan complete. Processed %d files, added %d recordings to the database",
+           state.processed_count, added_count);
+    if (state.failed_count > 0) {
+        printf(", %d could not be read", state.failed_count);
+    }
+    printf(".\n");
+    
+    if (migrate) {
+        int moved_count = 0;
+        if (migrate_layout(mp4_path, &moved_count) != 0) {
+            log_error("Failed to move recordings into the sharded layout");
+            shutdown_database();
+            return 1;
+        }
+        printf("Moved %d recordings into the sharded layout.\n", moved_count);
+    }
     
     // Shutdown database
     shutdown_database();
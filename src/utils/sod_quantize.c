@@ -0,0 +1,114 @@
+/**
+ * @file sod_quantize.c
+ * @brief Utility to quantize a SOD CNN model to int8
+ *
+ * This utility runs the float model over a directory of calibration images,
+ * recording the input range of every convolutional layer, then writes int8
+ * weights with one scale per filter next to the model. load_sod_model picks
+ * the int8 weights up automatically when they are present.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "core/config.h"
+#include "video/sod_detection.h"
+#include "sod/sod.h"
+
+// Calibration images read from the directory
+#define MAX_CALIBRATION_IMAGES 256
+
+static void print_usage(const char *prog) {
+    fprintf(stderr, "Usage: %s <architecture> <model.sod> <image directory> [output]\n", prog);
+    fprintf(stderr, "  architecture     Built-in network (:voc, :face, ...) or network configuration file\n");
+    fprintf(stderr, "  model.sod        Float weights of the model\n");
+    fprintf(stderr, "  image directory  Images representative of the cameras, used for calibration\n");
+    fprintf(stderr, "  output           Int8 weights to write (default: model.sod%s)\n", SOD_INT8_MODEL_SUFFIX);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 4 || argc > 5) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    const char *arch = argv[1];
+    const char *model_path = argv[2];
+    const char *image_dir = argv[3];
+    char output_path[MAX_PATH_LENGTH];
+    if (argc == 5) {
+        strncpy(output_path, argv[4], sizeof(output_path) - 1);
+        output_path[sizeof(output_path) - 1] = '\0';
+    } else {
+        snprintf(output_path, sizeof(output_path), "%s%s", model_path, SOD_INT8_MODEL_SUFFIX);
+    }
+
+    // Loading the image directory changes into it, so resolve the output path first
+    if (output_path[0] != '/') {
+        char cwd[MAX_PATH_LENGTH];
+        char relative[MAX_PATH_LENGTH];
+        if (!getcwd(cwd, sizeof(cwd))) {
+            fprintf(stderr, "Cannot resolve the output path %s\n", output_path);
+            return 1;
+        }
+        strncpy(relative, output_path, sizeof(relative) - 1);
+        relative[sizeof(relative) - 1] = '\0';
+        snprintf(output_path, sizeof(output_path), "%s/%s", cwd, relative);
+    }
+
+    sod_cnn *net = NULL;
+    const char *err_msg = NULL;
+    if (sod_cnn_create(&net, arch, model_path, &err_msg) != SOD_OK || !net) {
+        fprintf(stderr, "Failed to load model %s: %s\n", model_path, err_msg ? err_msg : "Unknown error");
+        return 1;
+    }
+
+    sod_img *images = NULL;
+    int image_count = 0;
+    sod_img_set_load_from_directory(image_dir, &images, &image_count, MAX_CALIBRATION_IMAGES);
+    if (image_count < 1) {
+        fprintf(stderr, "No calibration images found in %s\n", image_dir);
+        sod_cnn_destroy(net);
+        return 1;
+    }
+
+    int width = 0, height = 0, channels = 0;
+    sod_cnn_get_network_size(net, &width, &height, &channels);
+    printf("Calibrating %s (%dx%dx%d) on %d images\n", model_path, width, height, channels, image_count);
+
+    sod_cnn_config(net, SOD_CNN_INT8_CALIBRATE, 1);
+    int used = 0;
+    for (int i = 0; i < image_count; i++) {
+        if (images[i].c != channels) {
+            continue;
+        }
+        float *blob = sod_cnn_prepare_image(net, images[i]);
+        if (!blob) {
+            continue;
+        }
+        sod_box *boxes = NULL;
+        int box_count = 0;
+        sod_cnn_predict(net, blob, &boxes, &box_count);
+        used++;
+    }
+    sod_cnn_config(net, SOD_CNN_INT8_CALIBRATE, 0);
+    sod_img_set_release(images, image_count);
+
+    if (used < 1) {
+        fprintf(stderr, "No image in %s has the %d channels the model expects\n", image_dir, channels);
+        sod_cnn_destroy(net);
+        return 1;
+    }
+
+    int rc = sod_cnn_save_int8(net, output_path);
+    sod_cnn_destroy(net);
+    if (rc != SOD_OK) {
+        fprintf(stderr, "Failed to write int8 weights to %s (error %d)\n", output_path, rc);
+        return 1;
+    }
+
+    printf("Wrote int8 weights calibrated on %d images to %s\n", used, output_path);
+    return 0;
+}
@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "core/logger.h"
+#include "video/annexb_filter.h"
+
+/**
+ * Check whether the extradata is an avcC or hvcC record
+ * Both start with configurationVersion 1, while Annex B extradata starts
+ * with a start code.
+ */
+static bool has_length_prefixed_extradata(const AVCodecParameters *codecpar) {
+    if (!codecpar->extradata || codecpar->extradata_size < 7) {
+        return false;
+    }
+    return codecpar->extradata[0] == 1;
+}
+
+/**
+ * Set up the filter for the codec parameters of an input stream
+ */
+int annexb_filter_configure(annexb_filter_t *filter, const AVCodecParameters *codecpar, AVRational time_base) {
+    if (!filter || !codecpar) {
+        return AVERROR(EINVAL);
+    }
+
+    if (filter->configured &&
+        filter->codec_id == codecpar->codec_id &&
+        filter->extradata == codecpar->extradata &&
+        filter->extradata_size == codecpar->extradata_size) {
+        return 0;
+    }
+
+    annexb_filter_free(filter);
+    filter->configured = true;
+    filter->codec_id = codecpar->codec_id;
+    filter->extradata = codecpar->extradata;
+    filter->extradata_size = codecpar->extradata_size;
+
+    const char *name = NULL;
+    if (codecpar->codec_id == AV_CODEC_ID_H264) {
+        name = "h264_mp4toannexb";
+    } else if (codecpar->codec_id == AV_CODEC_ID_HEVC) {
+        name = "hevc_mp4toannexb";
+    }
+
+    if (!name || !has_length_prefixed_extradata(codecpar)) {
+        return 0;
+    }
+
+    const AVBitStreamFilter *bsf = av_bsf_get_by_name(name);
+    if (!bsf) {
+        log_warn("Bitstream filter %s not available, passing packets through", name);
+        return AVERROR_BSF_NOT_FOUND;
+    }
+
+    int ret = av_bsf_alloc(bsf, &filter->ctx);
+    if (ret < 0) {
+        return ret;
+    }
+
+    ret = avcodec_parameters_copy(filter->ctx->par_in, codecpar);
+    if (ret >= 0) {
+        filter->ctx->time_base_in = time_base;
+        ret = av_bsf_init(filter->ctx);
+    }
+
+    if (ret < 0) {
+        char error_buf[AV_ERROR_MAX_STRING_SIZE] = {0};
+        av_strerror(ret, error_buf, AV_ERROR_MAX_STRING_SIZE);
+        log_warn("Failed to initialize %s: %s", name, error_buf);
+        av_bsf_free(&filter->ctx);
+        return ret;
+    }
+
+    log_info("Using %s for length-prefixed %s input", name, avcodec_get_name(codecpar->codec_id));
+    return 0;
+}
+
+/**
+ * Get the codec parameters of the filtered packets
+ */
+const AVCodecParameters *annexb_filter_output_parameters(const annexb_filter_t *filter) {
+    return filter && filter->ctx ? filter->ctx->par_out : NULL;
+}
+
+/**
+ * Convert a packet to Annex B in place
+ */
+int annexb_filter_apply(annexb_filter_t *filter, AVPacket *pkt) {
+    if (!filter || !filter->ctx) {
+        return 0;
+    }
+
+    // The mp4toannexb filters emit exactly one packet per input packet
+    int ret = av_bsf_send_packet(filter->ctx, pkt);
+    if (ret < 0) {
+        av_packet_unref(pkt);
+        return ret;
+    }
+
+    return av_bsf_receive_packet(filter->ctx, pkt);
+}
+
+/**
+ * Free the filter context
+ */
+void annexb_filter_free(annexb_filter_t *filter) {
+    if (!filter) {
+        return;
+    }
+
+    av_bsf_free(&filter->ctx);
+    filter->configured = false;
+    filter->extradata = NULL;
+    filter->extradata_size = 0;
+}
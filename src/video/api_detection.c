@@ -4,7 +4,6 @@
 #include <stdbool.h>
 #include <errno.h>
 #include <unistd.h>
-#include <sys/stat.h>
 #include <curl/curl.h>
 #include <cJSON.h>
 #include <pthread.h>
@@ -14,14 +13,20 @@
 #include "core/shutdown_coordinator.h"
 #include "video/api_detection.h"
 #include "video/detection_result.h"
+#include "video/jpeg_encoder.h"
 #include "video/stream_manager.h"
 #include "video/stream_state.h"
 #include "database/db_detections.h"
+#include "video/thread_utils.h"
 
-// Global variables
-static bool initialized = false;
-static CURL *curl_handle = NULL;
-static pthread_mutex_t curl_mutex = PTHREAD_MUTEX_INITIALIZER;
+// Seconds a request may take, connecting included
+#define API_REQUEST_TIMEOUT_S 10
+
+// Keep-alive connections per API host, shared by all streams
+#define API_MAX_HOST_CONNECTIONS 8
+
+// Idle easy handles kept for reuse
+#define API_EASY_POOL_SIZE 16
 
 // Structure to hold memory for curl response
 typedef struct {
@@ -29,6 +34,52 @@ typedef struct {
     size_t size;
 } memory_struct_t;
 
+// One detection request, from submission until its callback ran
+typedef struct api_request {
+    struct api_request *next;
+    CURL *easy;                          // Easy handle from the pool
+    curl_mime *mime;                     // Multipart body with the frame
+    memory_struct_t response;            // Response body
+    char url[1024];                      // URL with the query parameters
+    char stream_name[MAX_STREAM_NAME];   // Stream the frame is from, empty if none
+    int slot;                            // Index of the stream in the in-flight table
+    api_detection_callback_t callback;
+    void *user_data;
+} api_request_t;
+
+// Requests one stream has in flight
+typedef struct {
+    char stream_name[MAX_STREAM_NAME];
+    int inflight;
+} api_stream_slot_t;
+
+/*
+ * The client: one thread drives every request through a curl multi handle,
+ * which keeps the connections to the API alive between requests. Callers
+ * encode and set up their request on their own thread and only hand the
+ * easy handle over, so frames of different streams are encoded and sent
+ * in parallel.
+ */
+static struct {
+    pthread_mutex_t mutex;
+    pthread_t thread;
+    bool running;                        // Client thread accepts requests
+    CURLM *multi;
+    struct curl_slist *headers;          // Headers shared by all requests
+    api_request_t *pending;              // Submitted, not yet added to the multi handle
+    api_request_t *pending_tail;
+    api_request_t *active;               // Added to the multi handle (client thread only)
+    CURL *idle[API_EASY_POOL_SIZE];
+    int idle_count;
+    api_stream_slot_t streams[MAX_STREAMS + 1];
+} client = {
+    .mutex = PTHREAD_MUTEX_INITIALIZER
+};
+
+// Global variables
+static bool initialized = false;
+static bool curl_global_ready = false;
+
 // Callback function for curl to write data
 static size_t write_memory_callback(void *contents, size_t size, size_t nmemb, void *userp) {
     size_t realsize = size * nmemb;
@@ -49,452 +100,20 @@ static size_t write_memory_callback(void *contents, size_t size, size_t nmemb, v
 }
 
 /**
- * Initialize the API detection system
+ * Parse the JSON response of the API into a detection result
+ *
+ * @return 0 on success, -1 if the response is not a detection list
  */
-int init_api_detection_system(void) {
-    if (initialized && curl_handle) {
-        log_info("API detection system already initialized");
-        return 0;  // Already initialized and curl handle is valid
-    }
-
-    // If we have a curl handle but initialized is false, clean it up first
-    if (curl_handle) {
-        log_warn("API detection system has a curl handle but is marked as uninitialized, cleaning up");
-        curl_easy_cleanup(curl_handle);
-        curl_handle = NULL;
-    }
-
-    // Initialize curl
-    CURLcode global_init_result = curl_global_init(CURL_GLOBAL_ALL);
-    if (global_init_result != CURLE_OK) {
-        log_error("Failed to initialize curl global: %s", curl_easy_strerror(global_init_result));
-        return -1;
-    }
-
-    curl_handle = curl_easy_init();
-    if (!curl_handle) {
-        log_error("Failed to initialize curl handle");
-        curl_global_cleanup();
-        return -1;
-    }
-
-    initialized = true;
-    log_info("API detection system initialized successfully");
-    return 0;
-}
-
-/**
- * Shutdown the API detection system
- */
-void shutdown_api_detection_system(void) {
-    // CRITICAL FIX: Always attempt to clean up resources, even if not marked as initialized
-    log_info("Shutting down API detection system (initialized: %s, curl_handle: %p)",
-             initialized ? "yes" : "no", (void*)curl_handle);
-
-    // Cleanup curl handle if it exists
-    if (curl_handle) {
-        log_info("Cleaning up curl handle");
-        curl_easy_cleanup(curl_handle);
-        curl_handle = NULL;
-    }
-
-    // Only call global cleanup if we were initialized
-    if (initialized) {
-        log_info("Cleaning up curl global resources");
-        curl_global_cleanup();
-    }
-
-    initialized = false;
-    log_info("API detection system shutdown complete");
-}
-
-/**
- * Detect objects using the API
- */
-int detect_objects_api(const char *api_url, const unsigned char *frame_data,
-                      int width, int height, int channels, detection_result_t *result,
-                      const char *stream_name) {
-    // CRITICAL FIX: Check if we're in shutdown mode or if the stream has been stopped
-    if (is_shutdown_initiated()) {
-        log_info("API Detection: System shutdown in progress, skipping detection");
-        return -1;
-    }
-
-    // CRITICAL FIX: Add thread safety for curl operations
-    pthread_mutex_lock(&curl_mutex);
-    
-    // Initialize result to empty at the beginning to prevent segmentation fault
-    if (result) {
-        memset(result, 0, sizeof(detection_result_t));
-    } else {
-        log_error("API Detection: NULL result pointer provided");
-        pthread_mutex_unlock(&curl_mutex);
-        return -1;
-    }
-    
-    // CRITICAL FIX: Check if api_url is the special "api-detection" string
-    // If so, get the actual URL from the global config
-    const char *actual_api_url = api_url;
-    if (api_url && strcmp(api_url, "api-detection") == 0) {
-        // Get the API URL from the global config
-        extern config_t g_config;
-        actual_api_url = g_config.api_detection_url;
-        log_info("API Detection: Using API URL from config: %s", actual_api_url ? actual_api_url : "NULL");
-    }
-
-    log_info("API Detection: Starting detection with API URL: %s", actual_api_url);
-    log_info("API Detection: Frame dimensions: %dx%d, channels: %d", width, height, channels);
-    log_info("API Detection: Stream name: %s", stream_name ? stream_name : "NULL");
-
-    if (!initialized || !curl_handle) {
-        log_error("API detection system not initialized");
-        pthread_mutex_unlock(&curl_mutex);
-        return -1;
-    }
-
-    if (!actual_api_url || !frame_data || !result) {
-        log_error("Invalid parameters for detect_objects_api");
-        pthread_mutex_unlock(&curl_mutex);
-        return -1;
-    }
-
-    // Check if the URL is valid (must start with http:// or https://)
-    if (strncmp(actual_api_url, "http://", 7) != 0 && strncmp(actual_api_url, "https://", 8) != 0) {
-        log_error("API Detection: Invalid URL format: %s (must start with http:// or https://)", actual_api_url);
-        pthread_mutex_unlock(&curl_mutex);
-        return -1;
-    }
-
-    // Set up curl for multipart/form-data
-    struct curl_httppost *formpost = NULL;
-    struct curl_httppost *lastptr = NULL;
-
-    // Create a temporary file for the image data using mkstemp (safer than tmpnam)
-    char temp_filename[] = "/tmp/lightnvr_api_detection_XXXXXX";
-    int temp_fd = mkstemp(temp_filename);
-    if (temp_fd < 0) {
-        log_error("Failed to create temporary file: %s", strerror(errno));
-        pthread_mutex_unlock(&curl_mutex);
-        return -1;
-    }
-
-    char image_filename[256];
-    snprintf(image_filename, sizeof(image_filename), "%s.jpg", temp_filename);
-
-    // Convert file descriptor to FILE pointer
-    FILE *temp_file = fdopen(temp_fd, "wb");
-    if (!temp_file) {
-        log_error("Failed to open temporary file for writing: %s", strerror(errno));
-        close(temp_fd);
-        unlink(temp_filename);
-        pthread_mutex_unlock(&curl_mutex);
-        return -1;
-    }
-
-    // Write the raw image data to the file
-    size_t bytes_written = fwrite(frame_data, 1, width * height * channels, temp_file);
-    fclose(temp_file);
-
-    if (bytes_written != width * height * channels) {
-        log_error("Failed to write image data to temporary file");
-        remove(temp_filename);
-        pthread_mutex_unlock(&curl_mutex);
-        return -1;
-    }
-
-    // CRITICAL FIX: Modify the request to match the API server's expected format
-    // Based on working curl examples:
-    // curl -X 'POST' 'http://127.0.0.1:9001/api/v1/detect?backend=tflite&confidence_threshold=.5&return_image=false'
-    //   -H 'accept: application/json' -H 'Content-Type: multipart/form-data'
-    //   -F 'file=@image.jpg;type=image/jpeg'
-
-    // CRITICAL FIX: Determine the correct ImageMagick parameters based on channels with safety checks
-    const char *pixel_format = NULL;
-
-    // Validate channels to prevent segmentation faults
-    if (channels <= 0 || channels > 4) {
-        log_error("API Detection: Invalid number of channels: %d (must be 1, 3, or 4)", channels);
-        remove(temp_filename);
-        pthread_mutex_unlock(&curl_mutex);
-        return -1;
-    }
-
-    // Set pixel format based on validated channels
-    if (channels == 1) {
-        pixel_format = "gray";
-        log_info("API Detection: Using grayscale pixel format for %d channel", channels);
-    } else if (channels == 3) {
-        pixel_format = "rgb";
-        log_info("API Detection: Using RGB pixel format for %d channels", channels);
-    } else if (channels == 4) {
-        pixel_format = "rgba";
-        log_info("API Detection: Using RGBA pixel format for %d channels", channels);
-    }
-
-    // Double-check that pixel_format is set
-    if (!pixel_format) {
-        log_error("API Detection: Failed to determine pixel format for %d channels", channels);
-        remove(temp_filename);
-        pthread_mutex_unlock(&curl_mutex);
-        return -1;
-    }
-
-    // Validate width and height to prevent buffer overflows
-    if (width <= 0 || width > 10000 || height <= 0 || height > 10000) {
-        log_error("API Detection: Invalid image dimensions: %dx%d", width, height);
-        remove(temp_filename);
-        pthread_mutex_unlock(&curl_mutex);
-        return -1;
-    }
-
-
-    // Try an alternative approach using ffmpeg with safety checks
-    log_info("API Detection: Trying alternative conversion with ffmpeg");
-    char ffmpeg_cmd[1024] = {0}; // Initialize to zeros
-
-    // Determine the correct ffmpeg pixel format with safety checks
-    const char *ffmpeg_pixel_format = NULL;
-    if (channels == 1) {
-        ffmpeg_pixel_format = "gray";
-    } else if (channels == 3) {
-        ffmpeg_pixel_format = "rgb24";
-    } else if (channels == 4) {
-        ffmpeg_pixel_format = "rgba";
-    } else {
-        log_error("API Detection: Invalid number of channels for ffmpeg: %d", channels);
-        remove(temp_filename);
-        pthread_mutex_unlock(&curl_mutex);
-        return -1;
-    }
-
-    // Format the command with safety checks
-    int cmd_result = snprintf(ffmpeg_cmd, sizeof(ffmpeg_cmd),
-            "ffmpeg -f rawvideo -pixel_format %s -video_size %dx%d -i %s -y %s",
-            ffmpeg_pixel_format, width, height, temp_filename, image_filename);
-
-    // Check for buffer overflow
-    if (cmd_result < 0 || cmd_result >= (int)sizeof(ffmpeg_cmd)) {
-        log_error("API Detection: Command buffer overflow when formatting ffmpeg command");
-        remove(temp_filename);
-        pthread_mutex_unlock(&curl_mutex);
-        return -1;
-    }
-
-    log_info("API Detection: Running ffmpeg command: %s", ffmpeg_cmd);
-
-    int ffmpeg_result = system(ffmpeg_cmd);
-    if (ffmpeg_result != 0) {
-        log_error("API Detection: Failed to convert with ffmpeg (error code: %d)", ffmpeg_result);
-        log_info("API Detection: Falling back to raw data with application/octet-stream MIME type");
-
-        // CRITICAL FIX: Verify that temp_filename exists before adding it to the form
-        struct stat temp_stat;
-        if (stat(temp_filename, &temp_stat) != 0 || temp_stat.st_size == 0) {
-            log_error("API Detection: Temporary file is missing or empty: %s", temp_filename);
-            remove(temp_filename);
-            pthread_mutex_unlock(&curl_mutex);
-            return -1;
-        }
-
-        // Add the file to the form with the correct field name 'file' (not 'image')
-        CURLFORMcode form_result = curl_formadd(&formpost, &lastptr,
-                    CURLFORM_COPYNAME, "file",
-                    CURLFORM_FILE, temp_filename,
-                    CURLFORM_CONTENTTYPE, "application/octet-stream",
-                    CURLFORM_END);
-
-        // Check for curl form errors
-        if (form_result != CURL_FORMADD_OK) {
-            log_error("API Detection: Failed to add file to form (error code: %d)", form_result);
-            remove(temp_filename);
-            pthread_mutex_unlock(&curl_mutex);
-            return -1;
-        }
-    } else {
-        log_info("API Detection: Successfully converted raw data to JPEG with ffmpeg: %s", image_filename);
-
-        // CRITICAL FIX: Verify that image_filename exists before using it
-        struct stat image_stat;
-        if (stat(image_filename, &image_stat) != 0 || image_stat.st_size == 0) {
-            log_error("API Detection: Converted image file is missing or empty: %s", image_filename);
-            remove(temp_filename);
-            pthread_mutex_unlock(&curl_mutex);
-            return -1;
-        }
-    }
-
-    // Add the JPEG file to the form
-    // CRITICAL FIX: Check if image_filename exists before adding to form
-    struct stat image_stat;
-    memory_struct_t chunk = {0};
-    chunk.memory = NULL;
-    struct curl_slist *headers = NULL;
-    if (stat(image_filename, &image_stat) == 0 && image_stat.st_size > 0) {
-        CURLFORMcode form_result = curl_formadd(&formpost, &lastptr,
-                    CURLFORM_COPYNAME, "file",
-                    CURLFORM_FILE, image_filename,
-                    CURLFORM_CONTENTTYPE, "image/jpeg",
-                    CURLFORM_END);
-                    
-        if (form_result != CURL_FORMADD_OK) {
-            log_error("API Detection: Failed to add JPEG file to form (error code: %d)", form_result);
-            free(chunk.memory);
-            curl_formfree(formpost);
-            curl_slist_free_all(headers);
-            remove(temp_filename);
-            remove(image_filename);
-            result->count = 0;
-            pthread_mutex_unlock(&curl_mutex);
-            return -1;
-        }
-        
-        log_info("API Detection: Successfully added JPEG file to form: %s", image_filename);
-    } else {
-        log_error("API Detection: JPEG file missing or empty: %s", image_filename);
-        // Now we can safely free them
-        if (chunk.memory) free(chunk.memory);
-        if (formpost) curl_formfree(formpost);
-        if (headers) curl_slist_free_all(headers);
-        
-        remove(temp_filename);
-        if (stat(image_filename, &image_stat) == 0) {
-            remove(image_filename);
-        }
-        result->count = 0;
-        pthread_mutex_unlock(&curl_mutex);
-        return -1;
-    }
-
-    // Construct the URL with query parameters
-    char url_with_params[1024];
-    snprintf(url_with_params, sizeof(url_with_params),
-             "%s?backend=tflite&confidence_threshold=0.5&return_image=false",
-             actual_api_url);
-    log_info("API Detection: Using URL with parameters: %s", url_with_params);
-
-    // Set up the request with the URL including query parameters
-    curl_easy_setopt(curl_handle, CURLOPT_URL, url_with_params);
-    curl_easy_setopt(curl_handle, CURLOPT_HTTPPOST, formpost);
-
-    // Add the accept header
-    headers = curl_slist_append(headers, "accept: application/json");
-    curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, headers);
-
-    // Set up the response buffer
-    chunk.memory = malloc(1);
-    chunk.size = 0;
-
-    curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, write_memory_callback);
-    curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, (void *)&chunk);
-
-    // Set a timeout
-    curl_easy_setopt(curl_handle, CURLOPT_TIMEOUT, 10);
-
-    // Perform the request
-    log_info("API Detection: Sending request to %s", url_with_params);
-
-    // CRITICAL FIX: Check if curl handle is still valid before performing the request
-    if (!curl_handle || !initialized) {
-        log_error("API Detection: curl handle is invalid or API detection system not initialized");
-        free(chunk.memory);
-        curl_formfree(formpost);
-        curl_slist_free_all(headers);
-
-        // Clean up the temporary files
-        remove(temp_filename);
-        // Remove the JPEG file if it was created by either ImageMagick or ffmpeg
-        struct stat st;
-        if (stat(image_filename, &st) == 0) {
-            log_info("API Detection: Removing temporary JPEG file: %s", image_filename);
-            remove(image_filename);
-        }
-
-        // Initialize result to empty to prevent segmentation fault
-        result->count = 0;
-        pthread_mutex_unlock(&curl_mutex);
-        return -1;
-    }
-
-    CURLcode res = curl_easy_perform(curl_handle);
-
-    // Clean up the temporary files
-    remove(temp_filename);
-    // Remove the JPEG file if it was created by either ImageMagick or ffmpeg
-    struct stat st;
-    if (stat(image_filename, &st) == 0) {
-        log_info("API Detection: Removing temporary JPEG file: %s", image_filename);
-        remove(image_filename);
-    }
-
-    // Check for errors
-    if (res != CURLE_OK) {
-        log_error("API Detection: curl_easy_perform() failed: %s", curl_easy_strerror(res));
-
-        // Check if it's a connection error
-        if (res == CURLE_COULDNT_CONNECT) {
-            log_error("API Detection: Could not connect to server at %s. Is the API server running?", url_with_params);
-        } else if (res == CURLE_OPERATION_TIMEDOUT) {
-            log_error("API Detection: Connection to %s timed out. Server might be slow or unreachable.", url_with_params);
-        } else if (res == CURLE_COULDNT_RESOLVE_HOST) {
-            log_error("API Detection: Could not resolve host %s. Check your network connection and DNS settings.", url_with_params);
-        } else if (res == CURLE_FAILED_INIT) {
-            log_error("API Detection: Curl initialization failed. Reinitializing curl handle...");
-
-            // Attempt to reinitialize curl
-            if (curl_handle) {
-                curl_easy_cleanup(curl_handle);
-                curl_handle = NULL;
-            }
-
-            curl_handle = curl_easy_init();
-            if (!curl_handle) {
-                log_error("API Detection: Failed to reinitialize curl handle");
-                initialized = false; // Mark as uninitialized to force reinitialization next time
-            } else {
-                log_info("API Detection: Successfully reinitialized curl handle");
-            }
-        }
-
-        free(chunk.memory);
-        curl_formfree(formpost);
-        curl_slist_free_all(headers);
-
-        // Initialize result to empty to prevent segmentation fault
-        result->count = 0;
-        pthread_mutex_unlock(&curl_mutex);
-        return -1;
-    }
-
-    // Get the HTTP response code
-    long http_code = 0;
-    curl_easy_getinfo(curl_handle, CURLINFO_RESPONSE_CODE, &http_code);
-
-    if (http_code != 200) {
-        log_error("API request failed with HTTP code %ld", http_code);
-        free(chunk.memory);
-        curl_formfree(formpost);
-        curl_slist_free_all(headers);
-        pthread_mutex_unlock(&curl_mutex);
-        return -1;
-    }
-
-    // Parse the JSON response
-    // CRITICAL FIX: Add additional logging and validation for JSON parsing
-    if (!chunk.memory || chunk.size == 0) {
+static int parse_detection_response(const memory_struct_t *response, detection_result_t *result) {
+    if (!response->memory || response->size == 0) {
         log_error("API Detection: Empty response from server");
-        free(chunk.memory);
-        curl_formfree(formpost);
-        curl_slist_free_all(headers);
-        // Initialize result to empty to prevent segmentation fault
-        result->count = 0;
-        pthread_mutex_unlock(&curl_mutex);
         return -1;
     }
 
     // Log the first few bytes of the response for debugging
     char preview[64] = {0};
-    int preview_len = chunk.size < 63 ? chunk.size : 63;
-    memcpy(preview, chunk.memory, preview_len);
+    int preview_len = response->size < 63 ? (int)response->size : 63;
+    memcpy(preview, response->memory, preview_len);
     preview[preview_len] = '\0';
     // Replace non-printable characters with dots
     for (int i = 0; i < preview_len; i++) {
@@ -502,22 +121,15 @@ int detect_objects_api(const char *api_url, const unsigned char *frame_data,
             preview[i] = '.';
         }
     }
-    log_info("API Detection: Response preview: %s", preview);
-
-    cJSON *root = cJSON_Parse(chunk.memory);
+    log_debug("API Detection: Response preview: %s", preview);
 
+    cJSON *root = cJSON_Parse(response->memory);
     if (!root) {
         const char *error_ptr = cJSON_GetErrorPtr();
         log_error("Failed to parse JSON response: %s", error_ptr ? error_ptr : "Unknown error");
         // Log more details about the response
-        log_error("API Detection: Response size: %zu bytes", chunk.size);
+        log_error("API Detection: Response size: %zu bytes", response->size);
         log_error("API Detection: Response preview: %s", preview);
-        free(chunk.memory);
-        curl_formfree(formpost);
-        curl_slist_free_all(headers);
-        // Initialize result to empty to prevent segmentation fault
-        result->count = 0;
-        pthread_mutex_unlock(&curl_mutex);
         return -1;
     }
 
@@ -532,12 +144,6 @@ int detect_objects_api(const char *api_url, const unsigned char *frame_data,
             free(json_str);
         }
         cJSON_Delete(root);
-        free(chunk.memory);
-        curl_formfree(formpost);
-        curl_slist_free_all(headers);
-        // Initialize result to empty to prevent segmentation fault
-        result->count = 0;
-        pthread_mutex_unlock(&curl_mutex);
         return -1;
     }
 
@@ -569,14 +175,12 @@ int detect_objects_api(const char *api_url, const unsigned char *frame_data,
             y_min = cJSON_GetObjectItem(bounding_box, "y_min");
             x_max = cJSON_GetObjectItem(bounding_box, "x_max");
             y_max = cJSON_GetObjectItem(bounding_box, "y_max");
-            log_info("API Detection: Found bounding_box object in JSON response");
         } else {
             // Try to get coordinates directly from the detection object (old format)
             x_min = cJSON_GetObjectItem(detection, "x_min");
             y_min = cJSON_GetObjectItem(detection, "y_min");
             x_max = cJSON_GetObjectItem(detection, "x_max");
             y_max = cJSON_GetObjectItem(detection, "y_max");
-            log_info("API Detection: Using direct coordinates from JSON response");
         }
 
         if (!label || !cJSON_IsString(label) ||
@@ -607,19 +211,520 @@ int detect_objects_api(const char *api_url, const unsigned char *frame_data,
         result->count++;
     }
 
+    cJSON_Delete(root);
+    return 0;
+}
+
+/**
+ * Take an in-flight slot of a stream
+ * Must be called with the client mutex held.
+ *
+ * @return Slot index, or -1 if the stream already has max_inflight requests out
+ */
+static int acquire_stream_slot(const char *stream_name, int max_inflight) {
+    int free_slot = -1;
+    for (int i = 0; i <= MAX_STREAMS; i++) {
+        api_stream_slot_t *slot = &client.streams[i];
+        if (strcmp(slot->stream_name, stream_name) == 0) {
+            if (slot->inflight >= max_inflight) {
+                return -1;
+            }
+            slot->inflight++;
+            return i;
+        }
+        if (slot->inflight == 0 && free_slot < 0) {
+            free_slot = i;
+        }
+    }
+
+    if (free_slot < 0) {
+        return -1;
+    }
+
+    api_stream_slot_t *slot = &client.streams[free_slot];
+    strncpy(slot->stream_name, stream_name, MAX_STREAM_NAME - 1);
+    slot->stream_name[MAX_STREAM_NAME - 1] = '\0';
+    slot->inflight = 1;
+    return free_slot;
+}
+
+/**
+ * Give the slot and easy handle of a request back and free it
+ */
+static void release_request(api_request_t *req) {
+    if (req->mime) {
+        curl_mime_free(req->mime);
+        req->mime = NULL;
+    }
+
+    pthread_mutex_lock(&client.mutex);
+    if (req->slot >= 0 && client.streams[req->slot].inflight > 0) {
+        client.streams[req->slot].inflight--;
+    }
+    if (req->easy) {
+        if (client.idle_count < API_EASY_POOL_SIZE) {
+            curl_easy_reset(req->easy);
+            client.idle[client.idle_count++] = req->easy;
+        } else {
+            curl_easy_cleanup(req->easy);
+        }
+        req->easy = NULL;
+    }
+    pthread_mutex_unlock(&client.mutex);
+
+    free(req->response.memory);
+    free(req);
+}
+
+/**
+ * Deliver the outcome of a request to its callback and release it
+ * Runs on the client thread.
+ */
+static void complete_request(api_request_t *req, CURLcode code) {
+    detection_result_t result;
+    memset(&result, 0, sizeof(detection_result_t));
+    int status = -1;
+
+    if (code != CURLE_OK) {
+        log_error("API Detection: request to %s failed: %s", req->url, curl_easy_strerror(code));
+
+        // Check if it's a connection error
+        if (code == CURLE_COULDNT_CONNECT) {
+            log_error("API Detection: Could not connect to server at %s. Is the API server running?", req->url);
+        } else if (code == CURLE_OPERATION_TIMEDOUT) {
+            log_error("API Detection: Connection to %s timed out. Server might be slow or unreachable.", req->url);
+        } else if (code == CURLE_COULDNT_RESOLVE_HOST) {
+            log_error("API Detection: Could not resolve host %s. Check your network connection and DNS settings.", req->url);
+        }
+    } else {
+        // Get the HTTP response code
+        long http_code = 0;
+        curl_easy_getinfo(req->easy, CURLINFO_RESPONSE_CODE, &http_code);
+
+        if (http_code != 200) {
+            log_error("API request failed with HTTP code %ld", http_code);
+        } else {
+            status = parse_detection_response(&req->response, &result);
+        }
+    }
+
     // Store the detections in the database if we have a valid stream name
-    if (stream_name && stream_name[0] != '\0') {
-        store_detections_in_db(stream_name, result, 0); // 0 means use current time
+    if (status == 0 && req->stream_name[0] != '\0') {
+        store_detections_in_db(req->stream_name, &result, 0); // 0 means use current time
+    }
+
+    if (req->callback) {
+        req->callback(status, &result, req->user_data);
+    }
+    release_request(req);
+}
+
+/**
+ * Fail a request that never ran
+ */
+static void fail_request(api_request_t *req) {
+    detection_result_t result;
+    memset(&result, 0, sizeof(detection_result_t));
+
+    if (req->callback) {
+        req->callback(-1, &result, req->user_data);
+    }
+    release_request(req);
+}
+
+/**
+ * Drop a request from the list of active requests
+ */
+static void remove_active(api_request_t *req) {
+    for (api_request_t **link = &client.active; *link; link = &(*link)->next) {
+        if (*link == req) {
+            *link = req->next;
+            req->next = NULL;
+            return;
+        }
+    }
+}
+
+/**
+ * Client thread: adds submitted requests to the multi handle, drives the
+ * transfers and completes the finished ones
+ */
+static void *api_client_thread(void *arg) {
+    (void)arg;
+    thread_set_identity(THREAD_CLASS_DETECTION, "det-api", NULL);
+
+    while (true) {
+        pthread_mutex_lock(&client.mutex);
+        bool running = client.running;
+        api_request_t *pending = client.pending;
+        client.pending = NULL;
+        client.pending_tail = NULL;
+        pthread_mutex_unlock(&client.mutex);
+
+        while (pending) {
+            api_request_t *req = pending;
+            pending = req->next;
+            req->next = NULL;
+
+            if (!running || curl_multi_add_handle(client.multi, req->easy) != CURLM_OK) {
+                fail_request(req);
+                continue;
+            }
+            req->next = client.active;
+            client.active = req;
+        }
+
+        if (!running) {
+            break;
+        }
+
+        int still_running = 0;
+        curl_multi_perform(client.multi, &still_running);
+
+        CURLMsg *msg;
+        int queued = 0;
+        while ((msg = curl_multi_info_read(client.multi, &queued))) {
+            if (msg->msg != CURLMSG_DONE) {
+                continue;
+            }
+
+            // The message is gone once the handle is removed
+            CURL *easy = msg->easy_handle;
+            CURLcode code = msg->data.result;
+            api_request_t *req = NULL;
+            curl_easy_getinfo(easy, CURLINFO_PRIVATE, (char **)&req);
+            curl_multi_remove_handle(client.multi, easy);
+
+            if (req) {
+                remove_active(req);
+                complete_request(req, code);
+            }
+        }
+
+        // Sleeps until a transfer needs attention or a request is submitted
+        curl_multi_poll(client.multi, NULL, 0, 1000, NULL);
+    }
+
+    // Requests still in flight at shutdown fail
+    while (client.active) {
+        api_request_t *req = client.active;
+        client.active = req->next;
+        req->next = NULL;
+        curl_multi_remove_handle(client.multi, req->easy);
+        fail_request(req);
+    }
+
+    return NULL;
+}
+
+/**
+ * Initialize the API detection system
+ */
+int init_api_detection_system(void) {
+    pthread_mutex_lock(&client.mutex);
+    if (initialized) {
+        pthread_mutex_unlock(&client.mutex);
+        log_info("API detection system already initialized");
+        return 0;
+    }
+
+    // Initialize curl
+    if (!curl_global_ready) {
+        CURLcode global_init_result = curl_global_init(CURL_GLOBAL_ALL);
+        if (global_init_result != CURLE_OK) {
+            pthread_mutex_unlock(&client.mutex);
+            log_error("Failed to initialize curl global: %s", curl_easy_strerror(global_init_result));
+            return -1;
+        }
+        curl_global_ready = true;
+    }
+
+    client.multi = curl_multi_init();
+    if (!client.multi) {
+        pthread_mutex_unlock(&client.mutex);
+        log_error("Failed to initialize curl multi handle");
+        return -1;
+    }
+    curl_multi_setopt(client.multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long)API_MAX_HOST_CONNECTIONS);
+    curl_multi_setopt(client.multi, CURLMOPT_MAXCONNECTS, (long)API_MAX_HOST_CONNECTIONS);
+
+    client.headers = curl_slist_append(NULL, "accept: application/json");
+    memset(client.streams, 0, sizeof(client.streams));
+    client.pending = NULL;
+    client.pending_tail = NULL;
+    client.active = NULL;
+    client.running = true;
+
+    if (pthread_create(&client.thread, NULL, api_client_thread, NULL) != 0) {
+        client.running = false;
+        curl_slist_free_all(client.headers);
+        client.headers = NULL;
+        curl_multi_cleanup(client.multi);
+        client.multi = NULL;
+        pthread_mutex_unlock(&client.mutex);
+        log_error("Failed to start API detection client thread");
+        return -1;
+    }
+
+    initialized = true;
+    pthread_mutex_unlock(&client.mutex);
+
+    log_info("API detection system initialized successfully");
+    return 0;
+}
+
+/**
+ * Shutdown the API detection system
+ */
+void shutdown_api_detection_system(void) {
+    log_info("Shutting down API detection system (initialized: %s)", initialized ? "yes" : "no");
+
+    pthread_mutex_lock(&client.mutex);
+    bool was_initialized = initialized;
+    client.running = false;
+    initialized = false;
+    pthread_mutex_unlock(&client.mutex);
+
+    if (was_initialized) {
+        // The client thread fails the requests still out before it exits
+        curl_multi_wakeup(client.multi);
+        pthread_join(client.thread, NULL);
+
+        curl_multi_cleanup(client.multi);
+        client.multi = NULL;
+        curl_slist_free_all(client.headers);
+        client.headers = NULL;
+    }
+
+    pthread_mutex_lock(&client.mutex);
+    for (int i = 0; i < client.idle_count; i++) {
+        curl_easy_cleanup(client.idle[i]);
+    }
+    client.idle_count = 0;
+    pthread_mutex_unlock(&client.mutex);
+
+    // Only call global cleanup if we were initialized
+    if (curl_global_ready) {
+        log_info("Cleaning up curl global resources");
+        curl_global_cleanup();
+        curl_global_ready = false;
+    }
+
+    log_info("API detection system shutdown complete");
+}
+
+/**
+ * Submit a frame to the API
+ */
+int detect_objects_api_async(const char *api_url, const unsigned char *frame_data,
+                             int width, int height, int channels, const char *stream_name,
+                             api_detection_callback_t callback, void *user_data) {
+    if (is_shutdown_initiated()) {
+        log_info("API Detection: System shutdown in progress, skipping detection");
+        return -1;
+    }
+
+    // If api_url is the special "api-detection" string, get the actual URL from the global config
+    const char *actual_api_url = api_url;
+    if (api_url && strcmp(api_url, "api-detection") == 0) {
+        actual_api_url = g_config.api_detection_url;
+    }
+
+    if (!actual_api_url || !frame_data) {
+        log_error("Invalid parameters for detect_objects_api");
+        return -1;
+    }
+
+    // Check if the URL is valid (must start with http:// or https://)
+    if (strncmp(actual_api_url, "http://", 7) != 0 && strncmp(actual_api_url, "https://", 8) != 0) {
+        log_error("API Detection: Invalid URL format: %s (must start with http:// or https://)", actual_api_url);
+        return -1;
+    }
+
+    // Validate channels and dimensions
+    if (channels != 1 && channels != 3 && channels != 4) {
+        log_error("API Detection: Invalid number of channels: %d (must be 1, 3, or 4)", channels);
+        return -1;
+    }
+    if (width <= 0 || width > 10000 || height <= 0 || height > 10000) {
+        log_error("API Detection: Invalid image dimensions: %dx%d", width, height);
+        return -1;
+    }
+
+    api_request_t *req = calloc(1, sizeof(api_request_t));
+    if (!req) {
+        log_error("API Detection: Failed to allocate request");
+        return -1;
+    }
+    req->slot = -1;
+    req->callback = callback;
+    req->user_data = user_data;
+    if (stream_name) {
+        strncpy(req->stream_name, stream_name, MAX_STREAM_NAME - 1);
+        req->stream_name[MAX_STREAM_NAME - 1] = '\0';
+    }
+
+    int max_inflight = g_config.api_detection_max_inflight > 0 ? g_config.api_detection_max_inflight : 1;
+
+    pthread_mutex_lock(&client.mutex);
+    if (!initialized || !client.running) {
+        pthread_mutex_unlock(&client.mutex);
+        log_error("API detection system not initialized");
+        free(req);
+        return -1;
+    }
+
+    req->slot = acquire_stream_slot(req->stream_name, max_inflight);
+    if (req->slot < 0) {
+        pthread_mutex_unlock(&client.mutex);
+        free(req);
+        return 1;
+    }
+
+    if (client.idle_count > 0) {
+        req->easy = client.idle[--client.idle_count];
+    }
+    pthread_mutex_unlock(&client.mutex);
+
+    if (!req->easy) {
+        req->easy = curl_easy_init();
+        if (!req->easy) {
+            log_error("API Detection: Failed to initialize curl handle");
+            release_request(req);
+            return -1;
+        }
+    }
+
+    // Encode the frame on the caller's thread; a raw upload is the fallback
+    const uint8_t *body = frame_data;
+    size_t body_size = (size_t)width * height * channels;
+    const char *content_type = "application/octet-stream";
+
+    jpeg_encoder_t *encoder = jpeg_encoder_for_thread();
+    const uint8_t *jpeg = NULL;
+    size_t jpeg_size = 0;
+    if (encoder && jpeg_encoder_encode(encoder, frame_data, width, height, channels,
+                                       g_config.api_detection_jpeg_quality, &jpeg, &jpeg_size) == 0) {
+        body = jpeg;
+        body_size = jpeg_size;
+        content_type = "image/jpeg";
     } else {
-        log_warn("No stream name provided, skipping database storage");
+        log_warn("API Detection: JPEG encoding failed, uploading the raw frame");
+    }
+
+    req->mime = curl_mime_init(req->easy);
+    curl_mimepart *part = req->mime ? curl_mime_addpart(req->mime) : NULL;
+    if (!part ||
+        curl_mime_name(part, "file") != CURLE_OK ||
+        curl_mime_filename(part, "frame.jpg") != CURLE_OK ||
+        curl_mime_type(part, content_type) != CURLE_OK ||
+        curl_mime_data(part, (const char *)body, body_size) != CURLE_OK) {
+        log_error("API Detection: Failed to build the request body");
+        release_request(req);
+        return -1;
     }
 
-    // Clean up
-    cJSON_Delete(root);
-    free(chunk.memory);
-    curl_formfree(formpost);
-    curl_slist_free_all(headers);
+    // Query parameters expected by the API server, e.g.
+    // curl -X 'POST' 'http://127.0.0.1:9001/api/v1/detect?backend=tflite&confidence_threshold=.5&return_image=false'
+    //   -H 'accept: application/json' -H 'Content-Type: multipart/form-data'
+    //   -F 'file=@image.jpg;type=image/jpeg'
+    snprintf(req->url, sizeof(req->url),
+             "%s?backend=tflite&confidence_threshold=0.5&return_image=false",
+             actual_api_url);
+
+    curl_easy_setopt(req->easy, CURLOPT_URL, req->url);
+    curl_easy_setopt(req->easy, CURLOPT_MIMEPOST, req->mime);
+    curl_easy_setopt(req->easy, CURLOPT_HTTPHEADER, client.headers);
+    curl_easy_setopt(req->easy, CURLOPT_WRITEFUNCTION, write_memory_callback);
+    curl_easy_setopt(req->easy, CURLOPT_WRITEDATA, (void *)&req->response);
+    curl_easy_setopt(req->easy, CURLOPT_PRIVATE, (void *)req);
+    curl_easy_setopt(req->easy, CURLOPT_TIMEOUT, (long)API_REQUEST_TIMEOUT_S);
+    curl_easy_setopt(req->easy, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(req->easy, CURLOPT_TCP_KEEPALIVE, 1L);
+    // Multiplex over an existing HTTP/2 connection rather than opening another
+    curl_easy_setopt(req->easy, CURLOPT_PIPEWAIT, 1L);
+
+    pthread_mutex_lock(&client.mutex);
+    if (!client.running) {
+        pthread_mutex_unlock(&client.mutex);
+        release_request(req);
+        return -1;
+    }
+    if (client.pending_tail) {
+        client.pending_tail->next = req;
+    } else {
+        client.pending = req;
+    }
+    client.pending_tail = req;
+    // Woken under the mutex, so shutdown cannot free the multi handle meanwhile
+    curl_multi_wakeup(client.multi);
+    pthread_mutex_unlock(&client.mutex);
 
-    pthread_mutex_unlock(&curl_mutex);
+    log_debug("API Detection: Queued %zu byte %s frame (%dx%d) for %s", body_size, content_type,
+              width, height, req->stream_name[0] ? req->stream_name : "unnamed stream");
     return 0;
 }
+
+// Caller waiting for a request in detect_objects_api
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    bool done;
+    int status;
+    detection_result_t *result;
+} api_waiter_t;
+
+static void wake_waiter(int status, const detection_result_t *result, void *user_data) {
+    api_waiter_t *waiter = (api_waiter_t *)user_data;
+
+    pthread_mutex_lock(&waiter->mutex);
+    memcpy(waiter->result, result, sizeof(detection_result_t));
+    waiter->status = status;
+    waiter->done = true;
+    pthread_cond_signal(&waiter->cond);
+    pthread_mutex_unlock(&waiter->mutex);
+}
+
+/**
+ * Detect objects using the API
+ */
+int detect_objects_api(const char *api_url, const unsigned char *frame_data,
+                      int width, int height, int channels, detection_result_t *result,
+                      const char *stream_name) {
+    if (!result) {
+        log_error("API Detection: NULL result pointer provided");
+        return -1;
+    }
+    memset(result, 0, sizeof(detection_result_t));
+
+    api_waiter_t waiter = {
+        .mutex = PTHREAD_MUTEX_INITIALIZER,
+        .cond = PTHREAD_COND_INITIALIZER,
+        .done = false,
+        .status = -1,
+        .result = result
+    };
+
+    int ret = detect_objects_api_async(api_url, frame_data, width, height, channels, stream_name,
+                                       wake_waiter, &waiter);
+    if (ret == 1) {
+        log_debug("API Detection: %s has too many requests in flight, skipping frame",
+                  stream_name ? stream_name : "unnamed stream");
+        return -1;
+    }
+    if (ret != 0) {
+        return -1;
+    }
+
+    // Every submitted request completes: the transfer times out, and
+    // shutdown fails the requests still out
+    pthread_mutex_lock(&waiter.mutex);
+    while (!waiter.done) {
+        pthread_cond_wait(&waiter.cond, &waiter.mutex);
+    }
+    pthread_mutex_unlock(&waiter.mutex);
+
+    pthread_mutex_destroy(&waiter.mutex);
+    pthread_cond_destroy(&waiter.cond);
+    return waiter.status;
+}
@@ -0,0 +1,307 @@
+/**
+ * Audio transcoding to AAC
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libavcodec/avcodec.h>
+#include <libavutil/audio_fifo.h>
+#include <libavutil/avutil.h>
+
+#include "core/config.h"
+#include "core/logger.h"
+#include "video/ffmpeg_utils.h"
+#include "video/audio_transcode.h"
+
+// Speech from a camera needs little; the encoder caps it further at low sample rates
+#define AUDIO_AAC_BIT_RATE_PER_CHANNEL 32000
+
+struct audio_transcoder {
+    char stream_name[MAX_STREAM_NAME];
+    AVCodecContext *decoder;
+    AVCodecContext *encoder;
+    AVCodecParameters *params;      // Of the AAC output
+    AVRational in_time_base;
+    AVFrame *decoded;
+    AVFrame *converted;             // Decoded samples as planar float
+    AVFrame *encoder_frame;         // One AAC frame taken from the FIFO
+    AVAudioFifo *fifo;
+    int channels;
+    int64_t next_pts;               // Output timestamp of the first sample in the FIFO
+};
+
+bool audio_transcode_needed(enum AVCodecID codec_id) {
+    return codec_id == AV_CODEC_ID_PCM_MULAW || codec_id == AV_CODEC_ID_PCM_ALAW;
+}
+
+/**
+ * Get the channel count of a codec context
+ */
+static int context_channels(const AVCodecContext *ctx) {
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(59, 37, 100)
+    return ctx->ch_layout.nb_channels;
+#else
+    return ctx->channels;
+#endif
+}
+
+/**
+ * Convert one sample to float
+ */
+static float sample_to_float(const uint8_t *data, enum AVSampleFormat format, int index) {
+    switch (format) {
+        case AV_SAMPLE_FMT_U8:
+        case AV_SAMPLE_FMT_U8P:
+            return ((int)data[index] - 128) / 128.0f;
+        case AV_SAMPLE_FMT_S16:
+        case AV_SAMPLE_FMT_S16P:
+            return ((const int16_t *)data)[index] / 32768.0f;
+        case AV_SAMPLE_FMT_S32:
+        case AV_SAMPLE_FMT_S32P:
+            return ((const int32_t *)data)[index] / 2147483648.0f;
+        case AV_SAMPLE_FMT_FLT:
+        case AV_SAMPLE_FMT_FLTP:
+            return ((const float *)data)[index];
+        case AV_SAMPLE_FMT_DBL:
+        case AV_SAMPLE_FMT_DBLP:
+            return (float)((const double *)data)[index];
+        default:
+            return 0.0f;
+    }
+}
+
+/**
+ * Convert a decoded frame to planar float in tc->converted
+ * G.711 decodes to 16-bit samples, so this is all the resampling needed;
+ * the sample rate and channels are kept.
+ */
+static int convert_frame(audio_transcoder_t *tc, const AVFrame *src) {
+    AVFrame *dst = tc->converted;
+    if (dst->nb_samples < src->nb_samples) {
+        av_frame_unref(dst);
+        dst->format = AV_SAMPLE_FMT_FLTP;
+        dst->sample_rate = tc->encoder->sample_rate;
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(59, 37, 100)
+        av_channel_layout_copy(&dst->ch_layout, &tc->encoder->ch_layout);
+#else
+        dst->channels = tc->channels;
+        dst->channel_layout = tc->encoder->channel_layout;
+#endif
+        dst->nb_samples = src->nb_samples;
+        int ret = av_frame_get_buffer(dst, 0);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+
+    enum AVSampleFormat format = (enum AVSampleFormat)src->format;
+    bool planar = av_sample_fmt_is_planar(format);
+    for (int ch = 0; ch < tc->channels; ch++) {
+        float *out = (float *)dst->data[ch];
+        for (int i = 0; i < src->nb_samples; i++) {
+            out[i] = planar ? sample_to_float(src->extended_data[ch], format, i)
+                            : sample_to_float(src->extended_data[0], format, i * tc->channels + ch);
+        }
+    }
+    return 0;
+}
+
+audio_transcoder_t *audio_transcoder_create(const char *stream_name, const AVCodecParameters *codecpar,
+                                            AVRational time_base) {
+    if (!stream_name || !codecpar) {
+        return NULL;
+    }
+
+    const AVCodec *decoder = avcodec_find_decoder(codecpar->codec_id);
+    const AVCodec *encoder = avcodec_find_encoder(AV_CODEC_ID_AAC);
+    if (!decoder || !encoder) {
+        log_error("No %s for audio transcoding of stream %s", decoder ? "AAC encoder" : "audio decoder",
+                 stream_name);
+        return NULL;
+    }
+
+    audio_transcoder_t *tc = calloc(1, sizeof(audio_transcoder_t));
+    if (!tc) {
+        log_error("Failed to allocate audio transcoder for stream %s", stream_name);
+        return NULL;
+    }
+    strncpy(tc->stream_name, stream_name, MAX_STREAM_NAME - 1);
+    tc->in_time_base = time_base;
+    tc->next_pts = AV_NOPTS_VALUE;
+
+    tc->decoder = avcodec_alloc_context3(decoder);
+    if (!tc->decoder || avcodec_parameters_to_context(tc->decoder, codecpar) < 0) {
+        log_error("Failed to set up audio decoder for stream %s", stream_name);
+        goto fail;
+    }
+    tc->decoder->pkt_timebase = time_base;
+    int ret = avcodec_open2(tc->decoder, decoder, NULL);
+    if (ret < 0) {
+        log_ffmpeg_error(ret, "Failed to open audio decoder");
+        goto fail;
+    }
+
+    tc->encoder = avcodec_alloc_context3(encoder);
+    if (!tc->encoder) {
+        goto fail;
+    }
+    tc->encoder->sample_fmt = AV_SAMPLE_FMT_FLTP;
+    tc->encoder->sample_rate = tc->decoder->sample_rate > 0 ? tc->decoder->sample_rate : 8000;
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(59, 37, 100)
+    if (tc->decoder->ch_layout.nb_channels > 0) {
+        av_channel_layout_default(&tc->encoder->ch_layout, tc->decoder->ch_layout.nb_channels);
+    } else {
+        av_channel_layout_default(&tc->encoder->ch_layout, 1);
+    }
+#else
+    tc->encoder->channels = tc->decoder->channels > 0 ? tc->decoder->channels : 1;
+    tc->encoder->channel_layout = av_get_default_channel_layout(tc->encoder->channels);
+#endif
+    tc->channels = context_channels(tc->encoder);
+    tc->encoder->bit_rate = (int64_t)AUDIO_AAC_BIT_RATE_PER_CHANNEL * tc->channels;
+    tc->encoder->time_base = (AVRational){1, tc->encoder->sample_rate};
+    // MP4 takes the AudioSpecificConfig from extradata, MPEG-TS rebuilds ADTS headers from it
+    tc->encoder->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+
+    ret = avcodec_open2(tc->encoder, encoder, NULL);
+    if (ret < 0) {
+        log_ffmpeg_error(ret, "Failed to open AAC encoder");
+        goto fail;
+    }
+
+    tc->params = avcodec_parameters_alloc();
+    tc->decoded = av_frame_alloc();
+    tc->converted = av_frame_alloc();
+    tc->encoder_frame = av_frame_alloc();
+    tc->fifo = av_audio_fifo_alloc(AV_SAMPLE_FMT_FLTP, tc->channels, tc->encoder->frame_size * 2);
+    if (!tc->params || !tc->decoded || !tc->converted || !tc->encoder_frame || !tc->fifo ||
+        avcodec_parameters_from_context(tc->params, tc->encoder) < 0) {
+        log_error("Failed to allocate audio transcoder buffers for stream %s", stream_name);
+        goto fail;
+    }
+
+    AVFrame *frame = tc->encoder_frame;
+    frame->format = AV_SAMPLE_FMT_FLTP;
+    frame->sample_rate = tc->encoder->sample_rate;
+    frame->nb_samples = tc->encoder->frame_size;
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(59, 37, 100)
+    av_channel_layout_copy(&frame->ch_layout, &tc->encoder->ch_layout);
+#else
+    frame->channels = tc->channels;
+    frame->channel_layout = tc->encoder->channel_layout;
+#endif
+    if (av_frame_get_buffer(frame, 0) < 0) {
+        goto fail;
+    }
+
+    log_info("Transcoding %s audio of stream %s to AAC (%d Hz, %d channels, %lld bit/s)",
+            decoder->name, stream_name, tc->encoder->sample_rate, tc->channels,
+            (long long)tc->encoder->bit_rate);
+    return tc;
+
+fail:
+    audio_transcoder_free(&tc);
+    return NULL;
+}
+
+const AVCodecParameters *audio_transcoder_get_parameters(const audio_transcoder_t *tc) {
+    return tc ? tc->params : NULL;
+}
+
+AVRational audio_transcoder_get_time_base(const audio_transcoder_t *tc) {
+    return tc ? tc->encoder->time_base : (AVRational){1, 8000};
+}
+
+int audio_transcoder_send_packet(audio_transcoder_t *tc, const AVPacket *pkt) {
+    if (!tc || !pkt) {
+        return AVERROR(EINVAL);
+    }
+
+    int ret = avcodec_send_packet(tc->decoder, pkt);
+    if (ret < 0) {
+        return ret;
+    }
+
+    while ((ret = avcodec_receive_frame(tc->decoder, tc->decoded)) == 0) {
+        int64_t pts = AV_NOPTS_VALUE;
+        if (tc->decoded->pts != AV_NOPTS_VALUE) {
+            pts = av_rescale_q(tc->decoded->pts, tc->in_time_base, tc->encoder->time_base);
+        }
+
+        // Continue the timeline unless the input jumped by more than half a second
+        int64_t expected = tc->next_pts == AV_NOPTS_VALUE ? AV_NOPTS_VALUE
+                                                          : tc->next_pts + av_audio_fifo_size(tc->fifo);
+        if (expected == AV_NOPTS_VALUE ||
+            (pts != AV_NOPTS_VALUE && llabs(pts - expected) > tc->encoder->sample_rate / 2)) {
+            av_audio_fifo_reset(tc->fifo);
+            tc->next_pts = pts != AV_NOPTS_VALUE ? pts : 0;
+        }
+
+        ret = convert_frame(tc, tc->decoded);
+        if (ret >= 0 && av_audio_fifo_write(tc->fifo, (void **)tc->converted->data,
+                                            tc->decoded->nb_samples) < tc->decoded->nb_samples) {
+            ret = AVERROR(ENOMEM);
+        }
+        av_frame_unref(tc->decoded);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+
+    return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF ? 0 : ret;
+}
+
+int audio_transcoder_receive_packet(audio_transcoder_t *tc, AVPacket *pkt) {
+    if (!tc || !pkt) {
+        return AVERROR(EINVAL);
+    }
+
+    // Frames are encoded as packets are taken, so the encoder never holds more than one
+    while (1) {
+        int ret = avcodec_receive_packet(tc->encoder, pkt);
+        if (ret != AVERROR(EAGAIN)) {
+            return ret;
+        }
+
+        int frame_size = tc->encoder->frame_size;
+        if (av_audio_fifo_size(tc->fifo) < frame_size) {
+            return AVERROR(EAGAIN);
+        }
+
+        ret = av_frame_make_writable(tc->encoder_frame);
+        if (ret < 0) {
+            return ret;
+        }
+        if (av_audio_fifo_read(tc->fifo, (void **)tc->encoder_frame->data, frame_size) < frame_size) {
+            return AVERROR(EIO);
+        }
+        tc->encoder_frame->pts = tc->next_pts;
+        tc->next_pts += frame_size;
+
+        ret = avcodec_send_frame(tc->encoder, tc->encoder_frame);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+}
+
+void audio_transcoder_free(audio_transcoder_t **tc) {
+    if (!tc || !*tc) {
+        return;
+    }
+
+    audio_transcoder_t *t = *tc;
+    avcodec_free_context(&t->decoder);
+    avcodec_free_context(&t->encoder);
+    avcodec_parameters_free(&t->params);
+    av_frame_free(&t->decoded);
+    av_frame_free(&t->converted);
+    av_frame_free(&t->encoder_frame);
+    if (t->fifo) {
+        av_audio_fifo_free(t->fifo);
+    }
+    free(t);
+    *tc = NULL;
+}
@@ -0,0 +1,657 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include <libavformat/avformat.h>
+#include <libavutil/crc.h>
+
+#include "core/logger.h"
+#include "video/clip_export.h"
+
+#define CLIP_EXPORT_AVIO_BUFFER_SIZE (64 * 1024)
+
+// ZIP record signatures
+#define ZIP_LOCAL_HEADER_SIG        0x04034b50
+#define ZIP_DATA_DESCRIPTOR_SIG     0x08074b50
+#define ZIP_CENTRAL_HEADER_SIG      0x02014b50
+#define ZIP64_END_RECORD_SIG        0x06064b50
+#define ZIP64_END_LOCATOR_SIG       0x07064b50
+#define ZIP_END_RECORD_SIG          0x06054b50
+
+// ZIP64, sizes in a data descriptor, UTF-8 names
+#define ZIP_VERSION                 45
+#define ZIP_FLAGS                   0x0808
+#define ZIP64_EXTRA_ID              0x0001
+
+// Export callback behind the muxer's AVIOContext
+typedef struct {
+    clip_export_write_fn write;
+    void *opaque;
+} clip_sink_t;
+
+// Muxer shared by the recordings of a clip
+typedef struct {
+    AVFormatContext *output;
+    clip_sink_t sink;
+    const char *path;           // File written with its index in front, NULL to write to sink
+    int chapters;               // Chapters reserved in a file, one per recording
+    bool keyframes_only;        // Leave out audio and all but the key frames
+    int video_out;
+    int audio_out;              // -1 if the clip has no audio
+    int64_t offset_us;          // Clip time the next recording starts at
+    int64_t end_us;             // End of the media written so far
+    int64_t last_dts[2];        // Last DTS written per output stream
+} clip_muxer_t;
+
+#if LIBAVFORMAT_VERSION_MAJOR >= 61
+static int avio_write_callback(void *opaque, const uint8_t *buf, int buf_size) {
+#else
+static int avio_write_callback(void *opaque, uint8_t *buf, int buf_size) {
+#endif
+    clip_sink_t *sink = (clip_sink_t *)opaque;
+    return sink->write(sink->opaque, buf, buf_size) < 0 ? AVERROR_EXIT : buf_size;
+}
+
+static bool same_parameters(const AVCodecParameters *a, const AVCodecParameters *b) {
+    if (a->codec_id != b->codec_id || a->width != b->width || a->height != b->height ||
+        a->sample_rate != b->sample_rate || a->extradata_size != b->extradata_size) {
+        return false;
+    }
+    return a->extradata_size == 0 || memcmp(a->extradata, b->extradata, a->extradata_size) == 0;
+}
+
+/**
+ * Create the muxer with the streams of the first recording and write the header
+ */
+static int open_muxer(clip_muxer_t *mux, const AVFormatContext *input, int video_index, int audio_index) {
+    if (avformat_alloc_output_context2(&mux->output, NULL, "mp4", NULL) < 0 || !mux->output) {
+        log_error("Failed to allocate clip export muxer");
+        return -1;
+    }
+
+    int indexes[2] = {video_index, audio_index};
+    for (int i = 0; i < 2; i++) {
+        if (indexes[i] < 0) {
+            continue;
+        }
+        const AVStream *in_stream = input->streams[indexes[i]];
+        AVStream *out_stream = avformat_new_stream(mux->output, NULL);
+        if (!out_stream || avcodec_parameters_copy(out_stream->codecpar, in_stream->codecpar) < 0) {
+            log_error("Failed to create clip export stream");
+            return -1;
+        }
+        out_stream->codecpar->codec_tag = 0;
+        out_stream->time_base = in_stream->time_base;
+        if (i == 0) {
+            mux->video_out = out_stream->index;
+        } else {
+            mux->audio_out = out_stream->index;
+        }
+    }
+
+    AVDictionary *options = NULL;
+    if (mux->path) {
+        if (avio_open(&mux->output->pb, mux->path, AVIO_FLAG_WRITE) < 0) {
+            log_error("Failed to create %s", mux->path);
+            return -1;
+        }
+
+        // Chapter times are only known once the recordings are written; the
+        // muxer reads them in the trailer, but needs them to exist now
+        for (int i = 0; i < mux->chapters; i++) {
+            AVChapter *chapter = av_mallocz(sizeof(AVChapter));
+            if (!chapter) {
+                return -1;
+            }
+            chapter->id = i;
+            chapter->time_base = (AVRational){1, 1000};
+            av_dynarray_add(&mux->output->chapters, (int *)&mux->output->nb_chapters, chapter);
+            if (!mux->output->chapters) {
+                return -1;
+            }
+        }
+
+        // The index is moved to the front once the file is complete
+        av_dict_set(&options, "movflags", "+faststart", 0);
+    } else {
+        uint8_t *buffer = av_malloc(CLIP_EXPORT_AVIO_BUFFER_SIZE);
+        if (!buffer) {
+            return -1;
+        }
+        mux->output->pb = avio_alloc_context(buffer, CLIP_EXPORT_AVIO_BUFFER_SIZE, 1, &mux->sink, NULL,
+                                             avio_write_callback, NULL);
+        if (!mux->output->pb) {
+            av_free(buffer);
+            return -1;
+        }
+
+        // The output cannot seek, so the moov goes first and each key frame starts a fragment
+        av_dict_set(&options, "movflags", "frag_keyframe+empty_moov+default_base_moof", 0);
+    }
+    mux->output->avoid_negative_ts = AVFMT_AVOID_NEG_TS_MAKE_NON_NEGATIVE;
+    int ret = avformat_write_header(mux->output, &options);
+    av_dict_free(&options);
+    if (ret < 0) {
+        log_error("Failed to write clip export header");
+        return -1;
+    }
+    return 0;
+}
+
+static void close_muxer(clip_muxer_t *mux) {
+    if (!mux->output) {
+        return;
+    }
+    if (mux->path) {
+        avio_closep(&mux->output->pb);
+    } else if (mux->output->pb) {
+        av_freep(&mux->output->pb->buffer);
+        avio_context_free(&mux->output->pb);
+    }
+    avformat_free_context(mux->output);
+    mux->output = NULL;
+}
+
+/**
+ * Append the part of one recording between start and end to the clip
+ *
+ * @return 0 on success or if the recording was left out, -1 if the output failed
+ */
+static int export_recording(clip_muxer_t *mux, const clip_export_source_t *source, time_t start, time_t end) {
+    AVFormatContext *input = NULL;
+    if (avformat_open_input(&input, source->file_path, NULL, NULL) < 0) {
+        log_warn("Failed to open recording %s for export", source->file_path);
+        return 0;
+    }
+
+    int video_index = av_find_best_stream(input, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+    int audio_index = -1;
+    for (unsigned int i = 0; i < input->nb_streams; i++) {
+        if (input->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_AUDIO) {
+            audio_index = (int)i;
+            break;
+        }
+    }
+    if (mux->keyframes_only) {
+        audio_index = -1;
+    }
+    if (video_index < 0) {
+        log_warn("Recording %s has no video stream to export", source->file_path);
+        avformat_close_input(&input);
+        return 0;
+    }
+
+    if (!mux->output) {
+        if (open_muxer(mux, input, video_index, audio_index) != 0) {
+            avformat_close_input(&input);
+            return -1;
+        }
+    } else if (!same_parameters(input->streams[video_index]->codecpar,
+                                mux->output->streams[mux->video_out]->codecpar)) {
+        log_warn("Leaving %s out of the export: its video differs from the start of the clip",
+                 source->file_path);
+        avformat_close_input(&input);
+        return 0;
+    }
+    if (audio_index >= 0 && (mux->audio_out < 0 ||
+                             !same_parameters(input->streams[audio_index]->codecpar,
+                                              mux->output->streams[mux->audio_out]->codecpar))) {
+        audio_index = -1;
+    }
+
+    const AVStream *video = input->streams[video_index];
+    AVRational video_tb = video->time_base;
+    int64_t first_ts = video->start_time != AV_NOPTS_VALUE ? video->start_time : 0;
+
+    // A recording compacted into a shared file starts at its offset there,
+    // and nothing before it is taken, even if a seek lands earlier
+    int64_t min_ts = INT64_MIN;
+    if (source->offset_ms > 0) {
+        first_ts += av_rescale_q(source->offset_ms, (AVRational){1, 1000}, video_tb);
+        min_ts = first_ts - av_rescale_q(1, (AVRational){1, 1000}, video_tb);
+    }
+    int64_t to_ts = first_ts + av_rescale_q((int64_t)(end - source->start_time), (AVRational){1, 1}, video_tb);
+    if (source->duration_ms > 0) {
+        int64_t last_ts = first_ts + av_rescale_q(source->duration_ms, (AVRational){1, 1000}, video_tb);
+        if (last_ts < to_ts) {
+            to_ts = last_ts;
+        }
+    }
+
+    // Start at the key frame at or before the start of the clip
+    if (start > source->start_time || source->offset_ms > 0) {
+        int64_t from_ts = first_ts;
+        if (start > source->start_time) {
+            from_ts += av_rescale_q((int64_t)(start - source->start_time), (AVRational){1, 1}, video_tb);
+        }
+        if (av_seek_frame(input, video_index, from_ts, AVSEEK_FLAG_BACKWARD) < 0) {
+            log_warn("Failed to seek in %s, exporting it from the start", source->file_path);
+        }
+    }
+
+    AVPacket *pkt = av_packet_alloc();
+    if (!pkt) {
+        avformat_close_input(&input);
+        return -1;
+    }
+
+    int ret = 0;
+    int64_t origin_ts = AV_NOPTS_VALUE;
+    bool video_done = false;
+    bool audio_done = audio_index < 0;
+    while (!video_done || !audio_done) {
+        if (av_read_frame(input, pkt) < 0) {
+            break;
+        }
+
+        bool is_video = pkt->stream_index == video_index;
+        AVStream *in_stream = input->streams[pkt->stream_index];
+        int64_t ts = pkt->dts != AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
+        if ((!is_video && pkt->stream_index != audio_index) || ts == AV_NOPTS_VALUE ||
+            (mux->keyframes_only && !(pkt->flags & AV_PKT_FLAG_KEY))) {
+            av_packet_unref(pkt);
+            continue;
+        }
+
+        // Nothing is kept before the first key frame, and nothing from the end on
+        int64_t video_ts = av_rescale_q(ts, in_stream->time_base, video_tb);
+        if (origin_ts == AV_NOPTS_VALUE) {
+            if (!is_video || !(pkt->flags & AV_PKT_FLAG_KEY) || video_ts < min_ts) {
+                av_packet_unref(pkt);
+                continue;
+            }
+            origin_ts = video_ts;
+        }
+        if (video_ts >= to_ts) {
+            if (is_video) {
+                video_done = true;
+            } else {
+                audio_done = true;
+            }
+            av_packet_unref(pkt);
+            continue;
+        }
+        if (video_ts < origin_ts) {
+            av_packet_unref(pkt);
+            continue;
+        }
+
+        // Move the recording to where the clip has got to
+        int64_t shift = av_rescale_q(mux->offset_us, AV_TIME_BASE_Q, in_stream->time_base) -
+                        av_rescale_q(origin_ts, video_tb, in_stream->time_base);
+        if (pkt->pts != AV_NOPTS_VALUE) {
+            pkt->pts += shift;
+        }
+        if (pkt->dts != AV_NOPTS_VALUE) {
+            pkt->dts += shift;
+        }
+        int64_t pkt_end = (pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts) + (pkt->duration > 0 ? pkt->duration : 1);
+        int64_t pkt_end_us = av_rescale_q(pkt_end, in_stream->time_base, AV_TIME_BASE_Q);
+        if (pkt_end_us > mux->end_us) {
+            mux->end_us = pkt_end_us;
+        }
+
+        int out_index = is_video ? mux->video_out : mux->audio_out;
+        AVStream *out_stream = mux->output->streams[out_index];
+        pkt->stream_index = out_index;
+        pkt->pos = -1;
+        av_packet_rescale_ts(pkt, in_stream->time_base, out_stream->time_base);
+
+        // Rounding at the joins must not make decode times go backwards
+        int64_t dts = pkt->dts != AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
+        if (dts <= mux->last_dts[out_index]) {
+            av_packet_unref(pkt);
+            continue;
+        }
+        mux->last_dts[out_index] = dts;
+
+        if (av_interleaved_write_frame(mux->output, pkt) < 0) {
+            if (mux->output->pb->error < 0) {
+                ret = -1;
+                break;
+            }
+            log_debug("Clip export muxer dropped a packet of %s", source->file_path);
+        }
+    }
+
+    mux->offset_us = mux->end_us;
+    av_packet_free(&pkt);
+    avformat_close_input(&input);
+    return ret;
+}
+
+/**
+ * Export a time range of recordings as one fragmented MP4
+ */
+int clip_export_mp4(const clip_export_source_t *sources, int count, time_t start, time_t end,
+                    clip_export_write_fn write, void *opaque) {
+    if (!sources || count <= 0 || end <= start || !write) {
+        return -1;
+    }
+
+    clip_muxer_t mux = {
+        .sink = {write, opaque},
+        .video_out = -1,
+        .audio_out = -1,
+        .last_dts = {INT64_MIN, INT64_MIN}
+    };
+
+    int ret = 0;
+    for (int i = 0; i < count && ret == 0; i++) {
+        if (sources[i].start_time >= end) {
+            continue;
+        }
+        ret = export_recording(&mux, &sources[i], start, end);
+    }
+
+    if (!mux.output) {
+        log_warn("No recording could be exported");
+        return -1;
+    }
+    if (ret == 0) {
+        if (av_write_trailer(mux.output) < 0) {
+            ret = -1;
+        }
+        avio_flush(mux.output->pb);
+        if (mux.output->pb->error < 0) {
+            ret = -1;
+        }
+    }
+    close_muxer(&mux);
+    return ret;
+}
+
+/**
+ * Copy recordings into one MP4 file, one after the other
+ */
+int clip_export_compact(const clip_export_source_t *sources, int count, const char *path,
+                        int64_t *offsets_ms, int64_t *durations_ms) {
+    if (!sources || count <= 0 || !path || !offsets_ms || !durations_ms) {
+        return -1;
+    }
+
+    clip_muxer_t mux = {
+        .path = path,
+        .chapters = count,
+        .video_out = -1,
+        .audio_out = -1,
+        .last_dts = {INT64_MIN, INT64_MIN}
+    };
+
+    int ret = 0;
+    int kept = 0;
+    for (int i = 0; i < count && ret == 0; i++) {
+        // A recording never lasts a day; the whole of it is taken
+        int64_t start_us = mux.end_us;
+        ret = export_recording(&mux, &sources[i], sources[i].start_time,
+                               sources[i].start_time + 24 * 3600);
+        offsets_ms[i] = -1;
+        durations_ms[i] = 0;
+        if (ret != 0 || mux.end_us <= start_us) {
+            continue;
+        }
+
+        // Each recording is a chapter named after its wall clock start
+        offsets_ms[i] = (start_us + 999) / 1000;
+        durations_ms[i] = mux.end_us / 1000 - offsets_ms[i];
+        AVChapter *chapter = mux.output->chapters[kept++];
+        char title[32];
+        struct tm tm;
+        localtime_r(&sources[i].start_time, &tm);
+        strftime(title, sizeof(title), "%Y-%m-%d %H:%M:%S", &tm);
+        chapter->start = offsets_ms[i];
+        chapter->end = offsets_ms[i] + durations_ms[i];
+        av_dict_set(&chapter->metadata, "title", title, 0);
+    }
+
+    if (!mux.output) {
+        log_warn("No recording could be compacted into %s", path);
+        return -1;
+    }
+
+    // Chapters of recordings left out are dropped
+    while (mux.output->nb_chapters > (unsigned int)kept) {
+        AVChapter *chapter = mux.output->chapters[--mux.output->nb_chapters];
+        av_dict_free(&chapter->metadata);
+        av_freep(&chapter);
+    }
+
+    if (ret == 0 && (kept == 0 || av_write_trailer(mux.output) < 0)) {
+        ret = -1;
+    }
+    close_muxer(&mux);
+    return ret;
+}
+
+/**
+ * Copy the key frames of a recording into an MP4 file
+ */
+int clip_export_keyframes(const clip_export_source_t *source, const char *path) {
+    if (!source || !path) {
+        return -1;
+    }
+
+    clip_muxer_t mux = {
+        .path = path,
+        .keyframes_only = true,
+        .video_out = -1,
+        .audio_out = -1,
+        .last_dts = {INT64_MIN, INT64_MIN}
+    };
+
+    // A recording never lasts a day; the whole of it is taken
+    int ret = export_recording(&mux, source, source->start_time, source->start_time + 24 * 3600);
+    if (!mux.output) {
+        log_warn("Recording %s has no key frames to keep", source->file_path);
+        return -1;
+    }
+    if (ret == 0 && (mux.end_us == 0 || av_write_trailer(mux.output) < 0)) {
+        ret = -1;
+    }
+    close_muxer(&mux);
+    return ret;
+}
+
+// Archive written so far
+typedef struct {
+    clip_export_write_fn write;
+    void *opaque;
+    bool failed;                // The callback aborted the export
+    uint64_t offset;
+    const AVCRC *crc_table;
+    uint32_t crc;               // Of the current entry, not yet inverted
+    uint64_t size;              // Of the current entry
+} zip_writer_t;
+
+// Central directory data of a written entry
+typedef struct {
+    uint32_t crc;
+    uint64_t size;
+    uint64_t offset;
+} zip_entry_info_t;
+
+static uint8_t *put_le16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    return p + 2;
+}
+
+static uint8_t *put_le32(uint8_t *p, uint32_t v) {
+    p = put_le16(p, (uint16_t)v);
+    return put_le16(p, (uint16_t)(v >> 16));
+}
+
+static uint8_t *put_le64(uint8_t *p, uint64_t v) {
+    p = put_le32(p, (uint32_t)v);
+    return put_le32(p, (uint32_t)(v >> 32));
+}
+
+static uint32_t min_u32(uint64_t v) {
+    return v > UINT32_MAX ? UINT32_MAX : (uint32_t)v;
+}
+
+static int zip_write(zip_writer_t *zip, const uint8_t *data, size_t size) {
+    if (zip->failed || zip->write(zip->opaque, data, (int)size) < 0) {
+        zip->failed = true;
+        return -1;
+    }
+    zip->offset += size;
+    return 0;
+}
+
+// Write callback of the clip inside the current entry
+static int zip_write_entry_data(void *opaque, const uint8_t *data, int size) {
+    zip_writer_t *zip = (zip_writer_t *)opaque;
+    zip->crc = av_crc(zip->crc_table, zip->crc, data, (size_t)size);
+    zip->size += (uint64_t)size;
+    return zip_write(zip, data, (size_t)size);
+}
+
+static void dos_date_time(time_t t, uint16_t *date, uint16_t *time_of_day) {
+    struct tm tm;
+    localtime_r(&t, &tm);
+    if (tm.tm_year < 80) {
+        *date = (1 << 5) | 1;
+        *time_of_day = 0;
+        return;
+    }
+    *date = (uint16_t)(((tm.tm_year - 80) << 9) | ((tm.tm_mon + 1) << 5) | tm.tm_mday);
+    *time_of_day = (uint16_t)((tm.tm_hour << 11) | (tm.tm_min << 5) | (tm.tm_sec / 2));
+}
+
+/**
+ * Export a time range of several streams as a ZIP archive of MP4 clips
+ */
+int clip_export_zip(const clip_export_entry_t *entries, int count, time_t start, time_t end,
+                    clip_export_write_fn write, void *opaque) {
+    if (!entries || count <= 0 || end <= start || !write) {
+        return -1;
+    }
+
+    zip_entry_info_t *info = calloc((size_t)count, sizeof(zip_entry_info_t));
+    if (!info) {
+        return -1;
+    }
+
+    zip_writer_t zip = {
+        .write = write,
+        .opaque = opaque,
+        .crc_table = av_crc_get_table(AV_CRC_32_IEEE_LE)
+    };
+    uint16_t date, time_of_day;
+    dos_date_time(start, &date, &time_of_day);
+    uint8_t record[64];
+    uint8_t *p;
+
+    for (int i = 0; i < count && !zip.failed; i++) {
+        size_t name_len = strlen(entries[i].name);
+
+        // The sizes are not known yet; they follow the data
+        p = put_le32(record, ZIP_LOCAL_HEADER_SIG);
+        p = put_le16(p, ZIP_VERSION);
+        p = put_le16(p, ZIP_FLAGS);
+        p = put_le16(p, 0);                 // Stored
+        p = put_le16(p, time_of_day);
+        p = put_le16(p, date);
+        p = put_le32(p, 0);
+        p = put_le32(p, UINT32_MAX);        // Sizes are in the ZIP64 fields
+        p = put_le32(p, UINT32_MAX);
+        p = put_le16(p, (uint16_t)name_len);
+        p = put_le16(p, 20);
+        info[i].offset = zip.offset;
+        if (zip_write(&zip, record, (size_t)(p - record)) != 0 ||
+            zip_write(&zip, (const uint8_t *)entries[i].name, name_len) != 0) {
+            break;
+        }
+        p = put_le16(record, ZIP64_EXTRA_ID);
+        p = put_le16(p, 16);
+        p = put_le64(p, 0);
+        p = put_le64(p, 0);
+        if (zip_write(&zip, record, (size_t)(p - record)) != 0) {
+            break;
+        }
+
+        // A clip that fails part way still ends its entry, so the archive stays valid
+        zip.crc = UINT32_MAX;
+        zip.size = 0;
+        if (clip_export_mp4(entries[i].sources, entries[i].count, start, end,
+                            zip_write_entry_data, &zip) != 0 && !zip.failed) {
+            log_warn("Clip export of archive entry %s is incomplete", entries[i].name);
+        }
+        info[i].crc = zip.crc ^ UINT32_MAX;
+        info[i].size = zip.size;
+
+        p = put_le32(record, ZIP_DATA_DESCRIPTOR_SIG);
+        p = put_le32(p, info[i].crc);
+        p = put_le64(p, info[i].size);
+        p = put_le64(p, info[i].size);
+        zip_write(&zip, record, (size_t)(p - record));
+    }
+
+    uint64_t directory_offset = zip.offset;
+    for (int i = 0; i < count && !zip.failed; i++) {
+        size_t name_len = strlen(entries[i].name);
+        p = put_le32(record, ZIP_CENTRAL_HEADER_SIG);
+        p = put_le16(p, (3 << 8) | ZIP_VERSION);   // Made on Unix
+        p = put_le16(p, ZIP_VERSION);
+        p = put_le16(p, ZIP_FLAGS);
+        p = put_le16(p, 0);
+        p = put_le16(p, time_of_day);
+        p = put_le16(p, date);
+        p = put_le32(p, info[i].crc);
+        p = put_le32(p, UINT32_MAX);
+        p = put_le32(p, UINT32_MAX);
+        p = put_le16(p, (uint16_t)name_len);
+        p = put_le16(p, 28);
+        p = put_le16(p, 0);                 // Comment
+        p = put_le16(p, 0);                 // Disk
+        p = put_le16(p, 0);                 // Internal attributes
+        p = put_le32(p, 0100644u << 16);    // Regular file, rw-r--r--
+        p = put_le32(p, UINT32_MAX);
+        if (zip_write(&zip, record, (size_t)(p - record)) != 0 ||
+            zip_write(&zip, (const uint8_t *)entries[i].name, name_len) != 0) {
+            break;
+        }
+        p = put_le16(record, ZIP64_EXTRA_ID);
+        p = put_le16(p, 24);
+        p = put_le64(p, info[i].size);
+        p = put_le64(p, info[i].size);
+        p = put_le64(p, info[i].offset);
+        zip_write(&zip, record, (size_t)(p - record));
+    }
+    free(info);
+
+    uint64_t directory_size = zip.offset - directory_offset;
+    uint64_t end_record_offset = zip.offset;
+    p = put_le32(record, ZIP64_END_RECORD_SIG);
+    p = put_le64(p, 44);                    // Size of the rest of the record
+    p = put_le16(p, (3 << 8) | ZIP_VERSION);
+    p = put_le16(p, ZIP_VERSION);
+    p = put_le32(p, 0);
+    p = put_le32(p, 0);
+    p = put_le64(p, (uint64_t)count);
+    p = put_le64(p, (uint64_t)count);
+    p = put_le64(p, directory_size);
+    p = put_le64(p, directory_offset);
+    zip_write(&zip, record, (size_t)(p - record));
+
+    p = put_le32(record, ZIP64_END_LOCATOR_SIG);
+    p = put_le32(p, 0);
+    p = put_le64(p, end_record_offset);
+    p = put_le32(p, 1);
+    zip_write(&zip, record, (size_t)(p - record));
+
+    p = put_le32(record, ZIP_END_RECORD_SIG);
+    p = put_le16(p, 0);
+    p = put_le16(p, 0);
+    p = put_le16(p, (uint16_t)(count > UINT16_MAX ? UINT16_MAX : count));
+    p = put_le16(p, (uint16_t)(count > UINT16_MAX ? UINT16_MAX : count));
+    p = put_le32(p, min_u32(directory_size));
+    p = put_le32(p, min_u32(directory_offset));
+    p = put_le16(p, 0);
+    zip_write(&zip, record, (size_t)(p - record));
+
+    return zip.failed ? -1 : 0;
+}
@@ -24,6 +24,7 @@
 #include "../../include/video/sod_realnet.h"
 #include "../../include/video/motion_detection.h"
 #include "../../include/video/api_detection.h"
+#include "../../include/video/remote_detection.h"
 #include "../../include/video/ffmpeg_utils.h"  // For comprehensive_ffmpeg_cleanup
 #include "../../include/core/logger.h"
 #include "../../include/core/config.h"  // For MAX_PATH_LENGTH
@@ -210,6 +211,9 @@ int detect_objects(detection_model_t model, const unsigned char *frame_data,
         log_error("TFLite detection not implemented yet");
         ret = -1;
     }
+    else if (strcmp(model_type, MODEL_TYPE_REMOTE) == 0) {
+        ret = detect_with_remote_model(model, frame_data, width, height, channels, result);
+    }
     else if (strcmp(model_type, MODEL_TYPE_API) == 0) {
         // For API models, the model_path contains the API URL
         const char *api_url = get_model_path(model);
@@ -9,6 +9,7 @@
 #include <time.h>
 
 #include "../../include/core/logger.h"
+#include "../../include/core/device_profile.h"
 #include "../../include/video/detection_config.h"
 
 // Default configuration for standard systems
@@ -69,31 +70,11 @@ int init_detection_config(void) {
     // Default to standard configuration
     current_config = &default_config;
 
-    // Check if we're running on an embedded device
-    FILE *meminfo = fopen("/proc/meminfo", "r");
-    if (meminfo) {
-        char line[256];
-        unsigned long total_mem_kb = 0;
-
-        while (fgets(line, sizeof(line), meminfo)) {
-            if (strncmp(line, "MemTotal:", 9) == 0) {
-                sscanf(line, "MemTotal: %lu", &total_mem_kb);
-                break;
-            }
-        }
-        fclose(meminfo);
-
-        // If total memory is less than 512MB, use embedded configuration
-        if (total_mem_kb > 0 && total_mem_kb < 512 * 1024) {
-            log_info("Detected embedded device with %lu KB RAM, using embedded configuration", total_mem_kb);
-            current_config = &embedded_config;
-        }
-    }
-
-    // Check number of CPU cores
-    int num_cores = sysconf(_SC_NPROCESSORS_ONLN);
-    if (num_cores > 0 && num_cores <= 2) {
-        log_info("Detected embedded device with %d CPU cores, using embedded configuration", num_cores);
+    // Small devices and those with few cores get the embedded configuration
+    const device_profile_t *profile = device_profile_get();
+    if (profile->tier == DEVICE_TIER_SMALL || profile->cores <= 2) {
+        log_info("Using embedded detection configuration on a %s device with %d cores",
+                 device_tier_name(profile->tier), profile->cores);
         current_config = &embedded_config;
     }
 
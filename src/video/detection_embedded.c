@@ -9,6 +9,7 @@
 #include <time.h>
 
 #include "../../include/core/logger.h"
+#include "../../include/core/device_profile.h"
 #include "../../include/video/detection_config.h"
 #include "../../include/video/detection_embedded.h"
 
@@ -24,41 +25,11 @@ bool is_embedded_device(void) {
         return is_embedded;
     }
     
-    // Check available system memory
-    FILE *meminfo = fopen("/proc/meminfo", "r");
-    if (meminfo) {
-        char line[256];
-        unsigned long total_mem_kb = 0;
-        
-        while (fgets(line, sizeof(line), meminfo)) {
-            if (strncmp(line, "MemTotal:", 9) == 0) {
-                sscanf(line, "MemTotal: %lu", &total_mem_kb);
-                break;
-            }
-        }
-        fclose(meminfo);
-        
-        // If total memory is less than 512MB, consider it an embedded device
-        if (total_mem_kb > 0 && total_mem_kb < 512 * 1024) {
-            log_info("Detected embedded device with %lu KB RAM", total_mem_kb);
-            is_embedded = true;
-            checked = true;
-            return true;
-        }
-    }
-    
-    // Check number of CPU cores
-    int num_cores = sysconf(_SC_NPROCESSORS_ONLN);
-    if (num_cores > 0 && num_cores <= 2) {
-        log_info("Detected embedded device with %d CPU cores", num_cores);
-        is_embedded = true;
-        checked = true;
-        return true;
-    }
-    
-    // Not an embedded device
+    // Small devices and those with few cores
+    const device_profile_t *profile = device_profile_get();
+    is_embedded = profile->tier == DEVICE_TIER_SMALL || profile->cores <= 2;
     checked = true;
-    return false;
+    return is_embedded;
 }
 
 /**
@@ -13,14 +13,16 @@
 #include <time.h>
 #include "core/logger.h"
 #include "core/config.h"
+#include "core/device_profile.h"
 #include "core/shutdown_coordinator.h"
-#include "utils/memory.h"  // For get_total_memory_allocated
+#include "utils/memory.h"
 #include "utils/strings.h"
 #include "video/detection_model.h"
 #include "video/sod_detection.h"
 #include "video/sod_realnet.h"
 #include "video/api_detection.h"
 #include "video/onvif_detection.h"
+#include "video/remote_detection.h"
 #include "sod/sod.h"  // For sod_cnn_destroy
 
 // Static variable to track if we're in shutdown mode
@@ -32,6 +34,36 @@ static bool in_shutdown_mode = false;
 // Global variables
 static bool initialized = false;
 
+// Model file sizes counted in the memory usage, until the models are unloaded
+#define MAX_ACCOUNTED_MODELS 32
+static struct {
+    detection_model_t model;
+    size_t bytes;
+} accounted_models[MAX_ACCOUNTED_MODELS];
+static pthread_mutex_t accounted_models_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Size of the blank frame run through TFLite models when they load
+#define TFLITE_WARMUP_SIZE 300
+
+/*
+ * TFLite models go through a small C shim library, libtensorflowlite.so,
+ * exporting:
+ *
+ *   void *tflite_load_model(const char *path);
+ *   void tflite_free_model(void *model);
+ *   void *tflite_detect(void *model, const unsigned char *rgb, int width,
+ *                       int height, int channels, int *count, float threshold);
+ *
+ * and optionally, to set up the interpreter:
+ *
+ *   void *tflite_load_model_with_options(const char *path, int num_threads,
+ *                                        const char *delegate);
+ *
+ * where delegate is "none", "xnnpack", "nnapi" or "edgetpu" and the call
+ * returns NULL when the delegate cannot be created. The results tflite_detect
+ * returns belong to the model and stay valid until its next call.
+ */
+
 // TFLite model structure
 typedef struct {
     void *handle;                // Dynamic library handle
@@ -49,11 +81,57 @@ typedef struct {
         void *sod;               // SOD model handle
         void *sod_realnet;       // SOD RealNet model handle
         tflite_model_t tflite;   // TFLite model handle
+        remote_connection_t *remote; // Connection to the inference server
     };
     float threshold;             // Detection threshold
     char path[MAX_PATH_LENGTH];  // Path to the model file (for reference)
 } model_t;
 
+/**
+ * Count a loaded model in the memory usage, by the size of its file
+ */
+static void account_model(detection_model_t model, size_t bytes) {
+    pthread_mutex_lock(&accounted_models_mutex);
+    for (int i = 0; i < MAX_ACCOUNTED_MODELS; i++) {
+        if (!accounted_models[i].model) {
+            accounted_models[i].model = model;
+            accounted_models[i].bytes = bytes;
+            memory_track(MEMORY_TAG_MODELS, bytes, true);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&accounted_models_mutex);
+}
+
+static void release_model_accounting(detection_model_t model) {
+    pthread_mutex_lock(&accounted_models_mutex);
+    for (int i = 0; i < MAX_ACCOUNTED_MODELS; i++) {
+        if (accounted_models[i].model == model) {
+            memory_track(MEMORY_TAG_MODELS, accounted_models[i].bytes, false);
+            accounted_models[i].model = NULL;
+            accounted_models[i].bytes = 0;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&accounted_models_mutex);
+}
+
+/**
+ * Get the memory a loaded model is counted with
+ */
+size_t get_model_memory_size(detection_model_t model) {
+    size_t bytes = 0;
+    pthread_mutex_lock(&accounted_models_mutex);
+    for (int i = 0; i < MAX_ACCOUNTED_MODELS; i++) {
+        if (accounted_models[i].model == model) {
+            bytes = accounted_models[i].bytes;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&accounted_models_mutex);
+    return bytes;
+}
+
 /**
  * Initialize the model system
  */
@@ -111,6 +189,11 @@ bool is_model_supported(const char *model_path) {
         return false;
     }
 
+    // Inference servers are reached when the model is used
+    if (remote_detection_address(model_path)) {
+        return true;
+    }
+
     // Check file extension
     const char *ext = strrchr(model_path, '.');
     if (!ext) {
@@ -153,6 +236,9 @@ const char* get_model_type(const char *model_path) {
     if (ends_with(model_path, "onvif")) {
         return MODEL_TYPE_ONVIF;
     }
+    if (remote_detection_address(model_path)) {
+        return MODEL_TYPE_REMOTE;
+    }
 
     // Check file extension
     const char *ext = strrchr(model_path, '.');
@@ -178,6 +264,82 @@ const char* get_model_type(const char *model_path) {
     return "unknown";
 }
 
+/**
+ * Number of interpreter threads for a TFLite model: the configured count, or
+ * the cores divided between the detection workers
+ */
+static int tflite_thread_count(void) {
+    if (g_config.tflite_threads > 0) {
+        return g_config.tflite_threads;
+    }
+
+    int cores = device_profile_get()->cores;
+    if (cores <= 1) {
+        return 1;
+    }
+
+    int workers = device_profile_value(DEVICE_KNOB_DETECTION_WORKERS);
+    return workers > 0 && workers < cores ? cores / workers : 1;
+}
+
+/**
+ * Load a TFLite model with the configured threads and delegate
+ * Falls back to the default CPU kernels when the delegate cannot be created,
+ * and to the library defaults when it does not take interpreter options.
+ */
+static void *load_tflite_interpreter(void *handle, void *(*tflite_load_model)(const char *),
+                                     const char *model_path) {
+    void *(*load_with_options)(const char *, int, const char *) =
+        dlsym(handle, "tflite_load_model_with_options");
+    if (!load_with_options) {
+        dlerror();
+        log_warn("TFLite library has no tflite_load_model_with_options, ignoring tflite_threads and tflite_delegate");
+        return tflite_load_model(model_path);
+    }
+
+    const char *delegate = g_config.tflite_delegate[0] ? g_config.tflite_delegate : "none";
+    int threads = tflite_thread_count();
+
+    void *tflite_model = load_with_options(model_path, threads, delegate);
+    if (!tflite_model && strcmp(delegate, "none") != 0) {
+        log_warn("TFLite delegate '%s' unavailable for %s, using the default CPU kernels",
+                 delegate, model_path);
+        delegate = "none";
+        tflite_model = load_with_options(model_path, threads, delegate);
+    }
+
+    if (tflite_model) {
+        log_info("TFLite interpreter for %s: %d threads, delegate %s", model_path, threads, delegate);
+    }
+    return tflite_model;
+}
+
+/**
+ * Run a blank frame through a freshly loaded TFLite model, so tensor
+ * allocation, kernel preparation and delegate compilation happen at load
+ * time instead of delaying the first detection
+ */
+static void warmup_tflite_model(const tflite_model_t *tflite, const char *model_path) {
+    size_t size = (size_t)TFLITE_WARMUP_SIZE * TFLITE_WARMUP_SIZE * 3;
+    unsigned char *frame = calloc(1, size);
+    if (!frame) {
+        log_warn("Failed to allocate TFLite warmup frame, skipping warmup");
+        return;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    int count = 0;
+    tflite->detect(tflite->model, frame, TFLITE_WARMUP_SIZE, TFLITE_WARMUP_SIZE, 3, &count, tflite->threshold);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    free(frame);
+
+    log_info("TFLite model %s warmed up in %ld ms", model_path,
+             (long)((end.tv_sec - start.tv_sec) * 1000 + (end.tv_nsec - start.tv_nsec) / 1000000));
+}
+
 /**
  * Load a TFLite model
  */
@@ -219,7 +381,7 @@ static detection_model_t load_tflite_model(const char *model_path, float thresho
     }
 
     // Load the model
-    void *tflite_model = tflite_load_model(model_path);
+    void *tflite_model = load_tflite_interpreter(handle, tflite_load_model, model_path);
     if (!tflite_model) {
         log_error("Failed to load TFLite model: %s", model_path);
         dlclose(handle);
@@ -246,6 +408,10 @@ static detection_model_t load_tflite_model(const char *model_path, float thresho
     strncpy(model->path, model_path, MAX_PATH_LENGTH - 1);
     model->path[MAX_PATH_LENGTH - 1] = '\0';  // Ensure null termination
 
+    if (g_config.tflite_warmup) {
+        warmup_tflite_model(&model->tflite, model_path);
+    }
+
     log_info("TFLite model loaded: %s", model_path);
     return model;
 }
@@ -280,6 +446,35 @@ void* get_realnet_model_handle(detection_model_t model) {
     return NULL;
 }
 
+/**
+ * Run detection with a remote model
+ */
+int detect_with_remote_model(detection_model_t model, const unsigned char *frame_data,
+                             int width, int height, int channels, detection_result_t *result) {
+    model_t *m = (model_t *)model;
+    if (!m || strcmp(m->type, MODEL_TYPE_REMOTE) != 0) {
+        log_error("Not a remote detection model");
+        return -1;
+    }
+
+    return remote_detection_detect(m->remote, frame_data, width, height, channels, m->threshold, result);
+}
+
+/**
+ * Change the detection threshold of a loaded model
+ */
+void set_detection_model_threshold(detection_model_t model, float threshold) {
+    model_t *m = (model_t *)model;
+    if (!m) {
+        return;
+    }
+
+    m->threshold = threshold;
+    if (strcmp(m->type, MODEL_TYPE_TFLITE) == 0) {
+        m->tflite.threshold = threshold;
+    }
+}
+
 /**
  * Get the type of a loaded model
  */
@@ -320,12 +515,17 @@ detection_model_t load_detection_model(const char *model_path, float threshold)
     // Check if this is an API URL (starts with http:// or https://) or the special "api-detection" string
     bool is_api_detection = ends_with(model_path, "api-detection");
     bool is_onvif_detection = ends_with(model_path, "onvif");
+    bool is_remote_detection = remote_detection_address(model_path) != NULL;
 
-    // Only check file existence if it's not an API URL or ONVIF
+    // Only check file existence if it's not an API URL, ONVIF or an inference server
+    size_t model_bytes = 0;
     if (is_api_detection) {
         log_info("API DETECTION: Using API for detection instead of a local model file");
     } else if (is_onvif_detection) {
         log_info("ONVIF DETECTION: Using ONVIF for detection instead of a local model file");
+    } else if (is_remote_detection) {
+        log_info("REMOTE DETECTION: Using inference server %s instead of a local model file",
+                 remote_detection_address(model_path));
     } else {
         // Check if file exists and get its size
         struct stat st;
@@ -342,6 +542,12 @@ detection_model_t load_detection_model(const char *model_path, float threshold)
         if (model_size_mb > MAX_MODEL_SIZE_MB) {
             log_warn("Large model detected: %.1f MB (limit: %d MB)", model_size_mb, MAX_MODEL_SIZE_MB);
         }
+
+        model_bytes = (size_t)st.st_size;
+        if (!memory_budget_allows(MEMORY_TAG_MODELS, model_bytes)) {
+            log_error("Not loading model %s: %.1f MB would exceed the memory budget", model_path, model_size_mb);
+            return NULL;
+        }
     }
 
     // Get model type
@@ -382,6 +588,23 @@ detection_model_t load_detection_model(const char *model_path, float threshold)
             log_info("ONVIF model created: %s", model_path);
         }
     }
+    else if (strcmp(model_type, MODEL_TYPE_REMOTE) == 0) {
+        remote_connection_t *conn = remote_detection_open(remote_detection_address(model_path));
+        if (conn) {
+            model_t *m = (model_t *)malloc(sizeof(model_t));
+            if (m) {
+                strncpy(m->type, MODEL_TYPE_REMOTE, sizeof(m->type) - 1);
+                m->type[sizeof(m->type) - 1] = '\0';
+                m->remote = conn;
+                m->threshold = threshold;
+                strncpy(m->path, model_path, MAX_PATH_LENGTH - 1);
+                m->path[MAX_PATH_LENGTH - 1] = '\0';  // Ensure null termination
+                model = m;
+            } else {
+                remote_detection_close(conn);
+            }
+        }
+    }
     else if (strcmp(model_type, MODEL_TYPE_SOD_REALNET) == 0) {
         void *realnet_model = load_sod_realnet_model(model_path, threshold);
         if (realnet_model) {
@@ -408,6 +631,9 @@ detection_model_t load_detection_model(const char *model_path, float threshold)
 
     if (model) {
         log_info("Successfully loaded model: %s", model_path);
+        if (model_bytes > 0) {
+            account_model(model, model_bytes);
+        }
     } else {
         log_error("Failed to load model: %s", model_path);
     }
@@ -423,6 +649,8 @@ void unload_detection_model(detection_model_t model) {
         return;
     }
 
+    release_model_accounting(model);
+
     model_t *m = (model_t *)model;
     char model_path[MAX_PATH_LENGTH] = {0};
 
@@ -491,6 +719,10 @@ void unload_detection_model(detection_model_t model) {
                 m->sod = NULL;
             }
         }
+    } else if (strcmp(m->type, MODEL_TYPE_REMOTE) == 0) {
+        // Other streams may still be using the connection
+        remote_detection_close(m->remote);
+        m->remote = NULL;
     } else if (strcmp(m->type, MODEL_TYPE_SOD_REALNET) == 0) {
         // Free SOD RealNet model - also try during shutdown
         if (m->sod_realnet) {
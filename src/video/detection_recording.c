@@ -12,12 +12,18 @@
 
 #include "core/logger.h"
 #include "core/config.h"
+#include "core/event_bus.h"
+#include "core/shutdown_coordinator.h"
 #include "video/stream_manager.h"
 #include "video/streams.h"
 #include "video/detection.h"
 #include "video/detection_result.h"
 #include "video/detection_stream.h"
 #include "video/detection_stream_thread.h"
+#include "video/remote_detection.h"
+#include "video/object_tracker.h"
+#include "video/stream_ingest.h"
+#include "video/detection_recording.h"
 #include "database/database_manager.h"
 #include "web/api_handlers_detection_results.h"
 
@@ -27,9 +33,15 @@
 #define MODEL_TYPE_TFLITE "tflite"
 #define MAX_DETECTION_AGE 30 // Maximum age of detections to consider (in seconds)
 
+// Events queued for the recording subscriber; it waits on the database, so
+// it gets room for a few seconds of results from every stream
+#define RECORDING_EVENT_CAPACITY 512
+
 // Forward declaration of model type detection function
 extern const char* detect_model_type(const char *model_path);
 
+static void detection_event_handler(const bus_event_t *event, void *ctx);
+
 // Structure to track detection-based recording state
 typedef struct {
     char stream_name[MAX_STREAM_NAME];
@@ -60,6 +72,13 @@ void init_detection_recording_system(void) {
 
     pthread_mutex_unlock(&detection_recordings_mutex);
 
+    // Detections reach recording and the database through the event bus,
+    // so detection threads never wait on either
+    if (event_bus_subscribe("recording", BUS_EVENT_MASK(BUS_EVENT_DETECTION) | BUS_EVENT_MASK(BUS_EVENT_ONVIF_MOTION),
+                            RECORDING_EVENT_CAPACITY, detection_event_handler, NULL) != 0) {
+        log_error("Failed to subscribe detection-based recording to detection events");
+    }
+
     log_info("Detection-based recording system initialized");
 }
 
@@ -214,6 +233,11 @@ int start_detection_recording(const char *stream_name, const char *model_path, f
     pthread_mutex_unlock(&detection_recordings[slot].mutex);
     pthread_mutex_unlock(&detection_recordings_mutex);
 
+    // Start buffering packets so event recordings can begin before the trigger
+    const stream_config_t *snapshot = stream_config_acquire(stream);
+    stream_ingest_set_preroll(stream_name, snapshot, pre_buffer);
+    stream_config_release(snapshot);
+
     // Update stream configuration to enable detection-based recording
     // Keep the original model_path in the configuration for simplicity
     set_stream_detection_recording(stream, true, model_path);
@@ -293,6 +317,9 @@ int stop_detection_recording(const char *stream_name) {
     pthread_mutex_unlock(&detection_recordings[slot].mutex);
     pthread_mutex_unlock(&detection_recordings_mutex);
 
+    // Release the pre-detection buffer
+    stream_ingest_set_preroll(stream_name, NULL, 0);
+
     // Update stream configuration to disable detection-based recording
     stream_handle_t stream = get_stream_by_name(stream_name);
     if (stream) {
@@ -312,29 +339,25 @@ int stop_detection_recording(const char *stream_name) {
     return 0;
 }
 
+// Static counter to track frames for each stream
+static int frame_counters[MAX_STREAMS] = {0};
+static char frame_counter_stream_names[MAX_STREAMS][MAX_STREAM_NAME] = {{0}};
+static pthread_mutex_t frame_counters_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 /**
  * Process detection results for recording
- * This function manages recording decisions based on detection results
+ * This function stores the detections and manages recording decisions
+ * based on them
  *
  * @param stream_name The name of the stream
- * @param frame_data The frame data (for debugging only)
- * @param width Frame width
- * @param height Frame height
- * @param channels Number of color channels
  * @param frame_time Timestamp of the frame
  * @param result Detection results from detect_objects call
  * @return 0 on success, -1 on error
  */
-// Static counter to track frames for each stream
-static int frame_counters[MAX_STREAMS] = {0};
-static char frame_counter_stream_names[MAX_STREAMS][MAX_STREAM_NAME] = {{0}};
-static pthread_mutex_t frame_counters_mutex = PTHREAD_MUTEX_INITIALIZER;
-
-int process_frame_for_recording(const char *stream_name, const unsigned char *frame_data,
-                               int width, int height, int channels, time_t frame_time,
-                               detection_result_t *result) {
-    if (!stream_name || !frame_data || !result) {
-        log_error("Invalid parameters for process_frame_for_recording");
+static int process_detections_for_recording(const char *stream_name, time_t frame_time,
+                                            const detection_result_t *result) {
+    if (!stream_name || !result) {
+        log_error("Invalid parameters for process_detections_for_recording");
         return -1;
     }
 
@@ -345,20 +368,26 @@ int process_frame_for_recording(const char *stream_name, const unsigned char *fr
         return -1;
     }
 
-    stream_config_t config;
-    if (get_stream_config(stream, &config) != 0) {
+    // Read for every detection, so take the stream's snapshot rather than a copy;
+    // everything below, the ingest's pre-roll included, reads the config from it
+    const stream_config_t *config = stream_config_acquire(stream);
+    if (!config) {
         log_error("Failed to get stream config for %s", stream_name);
         return -1;
     }
 
     // Check if detection is enabled for this stream
-    if (!config.detection_based_recording || config.detection_model[0] == '\0') {
+    if (!config->detection_based_recording || config->detection_model[0] == '\0') {
         log_info("Detection-based recording not enabled for stream %s", stream_name);
+        stream_config_release(config);
         return 0;
     }
 
+    // Keep the shared ingest's pre-detection buffer in line with the snapshot
+    stream_ingest_set_preroll(stream_name, config, config->pre_detection_buffer);
+
     // Get detection parameters from stream config
-    float threshold = config.detection_threshold;
+    float threshold = config->detection_threshold;
 
     // Log the threshold value for debugging
     log_info("Detection threshold from config: %.2f for stream %s", threshold, stream_name);
@@ -403,7 +432,7 @@ int process_frame_for_recording(const char *stream_name, const unsigned char *fr
     bool should_process = false;
 
     // If interval is 1, process every frame
-    if (config.detection_interval <= 1) {
+    if (config->detection_interval <= 1) {
         should_process = true;
         log_info("Processing every frame for detection on stream %s", stream_name);
     } else {
@@ -411,17 +440,18 @@ int process_frame_for_recording(const char *stream_name, const unsigned char *fr
         frame_counters[stream_index]++;
 
         // Process frame if counter reaches the interval or it's the first frame
-        if (frame_counters[stream_index] >= config.detection_interval || frame_counters[stream_index] == 1) {
+        if (frame_counters[stream_index] >= config->detection_interval || frame_counters[stream_index] == 1) {
             should_process = true;
             frame_counters[stream_index] = 0; // Reset counter
             log_info("Processing frame for detection on stream %s (interval: %d)",
-                    stream_name, config.detection_interval);
+                    stream_name, config->detection_interval);
         }
     }
     pthread_mutex_unlock(&frame_counters_mutex);
 
     // Skip processing if not at the right interval
     if (!should_process) {
+        stream_config_release(config);
         return 0;
     }
 
@@ -440,24 +470,38 @@ int process_frame_for_recording(const char *stream_name, const unsigned char *fr
         }
     }
 
-    // Only store if we have detections that meet the threshold
-    if (filtered_result.count > 0) {
-        log_info("STORING FILTERED DETECTION RESULTS with original stream name: %s (count: %d, original count: %d)",
-                stream_name, filtered_result.count, result->count);
+    // Follow the objects across frames, so an object that stays in view is
+    // stored when it appears, moves and leaves instead of on every frame
+    track_update_t tracks;
+    if (object_tracker_update(stream_name, &filtered_result, frame_time, &tracks) != 0) {
+        memset(&tracks, 0, sizeof(tracks));
+        tracks.changes = filtered_result;
+        tracks.new_tracks = filtered_result.count;
+    }
 
-        // Call store_detection_result but don't try to capture the return value since it's void
-        store_detection_result(stream_name, &filtered_result);
-        log_info("FILTERED DETECTION RESULT STORED");
-    } else {
+    // Ended tracks are stored at the time they were last seen
+    for (int i = 0; i < tracks.ended.count; i++) {
+        detection_result_t ended;
+        memset(&ended, 0, sizeof(detection_result_t));
+        ended.detections[0] = tracks.ended.detections[i];
+        ended.count = 1;
+        store_detections_in_db(stream_name, &ended, tracks.ended_at[i]);
+    }
+
+    if (tracks.changes.count > 0) {
+        log_info("Storing %d new or moved tracks for stream %s (%d detections above threshold)",
+                tracks.changes.count, stream_name, filtered_result.count);
+        store_detections_in_db(stream_name, &tracks.changes, frame_time);
+    } else if (filtered_result.count == 0) {
         log_info("No detections met the threshold (%.2f), skipping database storage", threshold);
     }
 
-    // Check if any objects were detected above threshold
-    bool detection_triggered = false;
+    // New tracks trigger recording; moving tracks keep it going through the
+    // rows they store, while objects that just sit there let it stop
+    bool detection_triggered = tracks.new_tracks > 0;
     for (int i = 0; i < result->count; i++) {
         if (result->detections[i].confidence >= threshold) {
-            detection_triggered = true;
-            log_info("DETECTION TRIGGERED for stream %s: %s (%.2f%%) at [%.2f, %.2f, %.2f, %.2f]",
+            log_info("DETECTION for stream %s: %s (%.2f%%) at [%.2f, %.2f, %.2f, %.2f]",
                     stream_name, result->detections[i].label,
                     result->detections[i].confidence * 100.0f,
                     result->detections[i].x, result->detections[i].y,
@@ -527,18 +571,15 @@ int process_frame_for_recording(const char *stream_name, const unsigned char *fr
         // If not already recording, start recording
         if (!recording_active) {
             //  Get the pre-buffer size from the stream config
-            int pre_buffer = config.pre_detection_buffer;
+            int pre_buffer = config->pre_detection_buffer;
 
-            // Start MP4 recording directly, using the same file rotation settings as regular recordings
+            // Start MP4 recording directly, using the same file rotation settings as regular recordings.
+            // The recording thread attaches to the shared ingest and starts with its pre-detection buffer.
             int mp4_result = start_mp4_recording(stream_name);
             if (mp4_result == 0) {
                 log_info("Started MP4 recording for detection event on stream %s with pre-buffer of %d seconds",
                          stream_name, pre_buffer);
 
-                // Pre-buffering is no longer used in the new architecture
-                // Each recording thread manages its own RTSP connection directly
-                log_info("Started MP4 recording for detection event on stream %s", stream_name);
-
                 // Update the recording_active flag in the detection_recordings array
                 pthread_mutex_lock(&detection_recordings_mutex);
                 for (int i = 0; i < MAX_STREAMS; i++) {
@@ -567,9 +608,27 @@ int process_frame_for_recording(const char *stream_name, const unsigned char *fr
         }
     }
 
+    stream_config_release(config);
     return 0;
 }
 
+/**
+ * Handle detections and ONVIF motion published on the event bus
+ * Frames with nothing found leave recording as it is.
+ */
+static void detection_event_handler(const bus_event_t *event, void *ctx) {
+    (void)ctx;
+
+    // MP4 writers are being closed and must not be started again
+    if (event->result.count == 0 || is_shutdown_initiated()) {
+        return;
+    }
+
+    if (process_detections_for_recording(event->stream_name, event->time, &event->result) != 0) {
+        log_error_ratelimited("[Stream %s] Failed to process detections for recording", event->stream_name);
+    }
+}
+
 /**
  * Monitor HLS segments for a stream and submit them to the detection thread pool
  * This function is called periodically to check for new HLS segments
@@ -837,6 +896,10 @@ int monitor_hls_segments_for_detection(const char *stream_name) {
             log_info("Using API detection for URL: %s", config.detection_model);
             strncpy(full_model_path, "api-detection", MAX_PATH_LENGTH - 1);
             full_model_path[MAX_PATH_LENGTH - 1] = '\0';
+        } else if (remote_detection_address(config.detection_model) == config.detection_model) {
+            // Inference server addresses are used as they are
+            strncpy(full_model_path, config.detection_model, MAX_PATH_LENGTH - 1);
+            full_model_path[MAX_PATH_LENGTH - 1] = '\0';
         } else if (config.detection_model[0] != '/') {
             // Construct full path using configured models path from INI if it exists
             if (g_config.models_path && strlen(g_config.models_path) > 0) {
@@ -0,0 +1,588 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/frame.h>
+#include <libswscale/swscale.h>
+
+#include "core/logger.h"
+#include "core/config.h"
+#include "video/detection_replay.h"
+#include "video/detection.h"
+#include "video/detection_model.h"
+#include "video/detection_embedded.h"
+#include "video/detection_scheduler.h"
+#include "video/detection_zones.h"
+#include "video/stream_registry.h"
+#include "video/thread_utils.h"
+#include "database/db_streams.h"
+#include "database/db_recordings.h"
+#include "database/db_detections.h"
+
+// Recordings decoded side by side, one per detection worker up to this many
+#define REPLAY_MAX_LANES 8
+
+// Recordings fetched from the database at a time
+#define REPLAY_PAGE_SIZE 32
+
+// Recordings starting this long before the range are read too, as they may
+// run into it
+#define REPLAY_LOOKBACK_SEC 3600
+
+// A replay and the recordings its lanes share
+typedef struct {
+    detection_replay_request_t request;     // With the model path and threshold resolved
+    detection_zone_t zones[MAX_DETECTION_ZONES];
+    int zone_count;
+
+    pthread_mutex_t mutex;                  // Protects the page of recordings
+    recording_metadata_t page[REPLAY_PAGE_SIZE];
+    int page_count;
+    int page_next;
+    recording_cursor_t cursor;
+    bool exhausted;
+} replay_job_t;
+
+// One recording at a time decoded and detected on
+typedef struct {
+    replay_job_t *job;
+    int index;
+    int stream_id;                          // Scheduler slot, STREAM_ID_INVALID to detect inline
+    detection_model_t model;
+    struct SwsContext *sws_ctx;
+    uint8_t *rgb_buffer;
+    size_t rgb_buffer_size;
+    int frame_count;
+    pthread_t thread;
+} replay_lane_t;
+
+static struct {
+    pthread_mutex_t mutex;                  // Protects status and the background thread
+    detection_replay_status_t status;
+    struct timespec started;                // Monotonic start of the current replay
+    pthread_t thread;
+    bool thread_started;
+    atomic_bool cancel;
+} replay = {
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+};
+
+const char *detection_replay_state_name(detection_replay_state_t state) {
+    switch (state) {
+        case DETECTION_REPLAY_RUNNING: return "running";
+        case DETECTION_REPLAY_DONE: return "done";
+        case DETECTION_REPLAY_CANCELLED: return "cancelled";
+        case DETECTION_REPLAY_FAILED: return "failed";
+        default: return "idle";
+    }
+}
+
+static double seconds_since(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - start->tv_sec) + (double)(now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/**
+ * Check a request and fill in the stream's model, threshold and zones
+ *
+ * @return 0 if the request can run, -1 with error set otherwise
+ */
+static int prepare_job(const detection_replay_request_t *request, replay_job_t *job,
+                       char *error, size_t error_size) {
+    memset(job, 0, sizeof(*job));
+    job->request = *request;
+
+    stream_config_t stream;
+    if (request->stream_name[0] == '\0' || get_stream_config_by_name(request->stream_name, &stream) != 0) {
+        snprintf(error, error_size, "Stream not found");
+        return -1;
+    }
+    if (request->start_time <= 0 || request->end_time <= request->start_time) {
+        snprintf(error, error_size, "The end of the range must follow its start");
+        return -1;
+    }
+    if (request->interval < 0) {
+        snprintf(error, error_size, "Invalid interval");
+        return -1;
+    }
+
+    const char *model = request->model_path[0] != '\0' ? request->model_path : stream.detection_model;
+    if (model[0] == '\0') {
+        snprintf(error, error_size, "No detection model");
+        return -1;
+    }
+    if (model[0] == '/') {
+        snprintf(job->request.model_path, sizeof(job->request.model_path), "%s", model);
+    } else {
+        snprintf(job->request.model_path, sizeof(job->request.model_path), "%s/%s", g_config.models_path, model);
+    }
+    if (!is_model_supported(job->request.model_path) ||
+        strcmp(get_model_type(job->request.model_path), MODEL_TYPE_API) == 0) {
+        snprintf(error, error_size, "Model cannot be replayed: %s", model);
+        return -1;
+    }
+
+    if (job->request.threshold <= 0.0f) {
+        job->request.threshold = stream.detection_threshold;
+    }
+
+    job->zone_count = parse_detection_zones(stream.detection_zones, job->zones, MAX_DETECTION_ZONES);
+    if (job->zone_count < 0) {
+        job->zone_count = 0;
+    }
+
+    pthread_mutex_init(&job->mutex, NULL);
+    return 0;
+}
+
+/**
+ * Take the next recording of the range for a lane
+ *
+ * @return true if one was taken, false once all are taken
+ */
+static bool next_recording(replay_job_t *job, recording_metadata_t *recording) {
+    bool found = false;
+
+    pthread_mutex_lock(&job->mutex);
+    while (!found && !atomic_load(&replay.cancel)) {
+        if (job->page_next >= job->page_count) {
+            if (job->exhausted) {
+                break;
+            }
+            int count = get_recording_metadata_after(job->request.start_time - REPLAY_LOOKBACK_SEC,
+                                                     job->request.end_time, job->request.stream_name, 0,
+                                                     "asc", &job->cursor, job->page, REPLAY_PAGE_SIZE);
+            job->page_count = count > 0 ? count : 0;
+            job->page_next = 0;
+            if (count < REPLAY_PAGE_SIZE) {
+                job->exhausted = true;
+            }
+            if (count > 0) {
+                job->cursor.start_time = job->page[count - 1].start_time;
+                job->cursor.id = job->page[count - 1].id;
+            }
+            continue;
+        }
+
+        *recording = job->page[job->page_next++];
+        found = recording->end_time >= job->request.start_time;
+    }
+    pthread_mutex_unlock(&job->mutex);
+
+    return found;
+}
+
+/**
+ * Convert a frame to RGB at the model's input scale and detect objects in it
+ */
+static int detect_frame(replay_lane_t *lane, const AVFrame *frame, detection_result_t *result) {
+    int downscale_factor = get_downscale_factor(get_model_type_from_handle(lane->model));
+    int width = (frame->width / downscale_factor / 2) * 2;
+    int height = (frame->height / downscale_factor / 2) * 2;
+
+    lane->sws_ctx = sws_getCachedContext(lane->sws_ctx, frame->width, frame->height, frame->format,
+                                         width, height, AV_PIX_FMT_RGB24, SWS_BILINEAR, NULL, NULL, NULL);
+    if (!lane->sws_ctx) {
+        return -1;
+    }
+
+    size_t rgb_size = (size_t)width * height * 3;
+    if (rgb_size > lane->rgb_buffer_size) {
+        uint8_t *grown = realloc(lane->rgb_buffer, rgb_size);
+        if (!grown) {
+            return -1;
+        }
+        lane->rgb_buffer = grown;
+        lane->rgb_buffer_size = rgb_size;
+    }
+
+    uint8_t *rgb_data[4] = {lane->rgb_buffer, NULL, NULL, NULL};
+    int rgb_linesize[4] = {width * 3, 0, 0, 0};
+    sws_scale(lane->sws_ctx, (const uint8_t *const *)frame->data, frame->linesize, 0, frame->height,
+              rgb_data, rgb_linesize);
+
+    memset(result, 0, sizeof(*result));
+    return detect_objects(lane->model, lane->rgb_buffer, width, height, 3, result);
+}
+
+/**
+ * Scheduler job detecting on one replayed frame
+ */
+static void replay_frame_job(void *ctx, const AVFrame *frame, int frame_count, time_t timestamp) {
+    replay_lane_t *lane = (replay_lane_t *)ctx;
+    replay_job_t *job = lane->job;
+    if (!frame) {
+        return;
+    }
+
+    detection_result_t result;
+    if (detect_frame(lane, frame, &result) != 0) {
+        log_error_ratelimited("[Stream %s] Replay detection failed on frame %d",
+                              job->request.stream_name, frame_count);
+        return;
+    }
+    filter_detections_by_zones(job->zones, job->zone_count, &result);
+
+    if (job->request.store && result.count > 0 &&
+        store_detections_in_db(job->request.stream_name, &result, timestamp) != 0) {
+        log_error_ratelimited("[Stream %s] Failed to store replayed detections", job->request.stream_name);
+    }
+
+    pthread_mutex_lock(&replay.mutex);
+    replay.status.frames++;
+    replay.status.detections += (uint64_t)result.count;
+    pthread_mutex_unlock(&replay.mutex);
+}
+
+/**
+ * Open the video stream of a recording with a decoder that only decodes key frames
+ */
+static int open_recording(const char *path, AVFormatContext **fmt_ctx, AVCodecContext **codec_ctx,
+                          int *stream_index) {
+    *fmt_ctx = NULL;
+    *codec_ctx = NULL;
+
+    if (avformat_open_input(fmt_ctx, path, NULL, NULL) != 0) {
+        return -1;
+    }
+    if (avformat_find_stream_info(*fmt_ctx, NULL) < 0) {
+        avformat_close_input(fmt_ctx);
+        return -1;
+    }
+
+    const AVCodec *codec = NULL;
+    int index = av_find_best_stream(*fmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, &codec, 0);
+    if (index < 0 || !codec) {
+        avformat_close_input(fmt_ctx);
+        return -1;
+    }
+
+    *codec_ctx = avcodec_alloc_context3(codec);
+    if (!*codec_ctx ||
+        avcodec_parameters_to_context(*codec_ctx, (*fmt_ctx)->streams[index]->codecpar) < 0) {
+        avcodec_free_context(codec_ctx);
+        avformat_close_input(fmt_ctx);
+        return -1;
+    }
+
+    // One thread per decoder: the lanes already keep the cores busy
+    (*codec_ctx)->thread_count = 1;
+    (*codec_ctx)->skip_frame = AVDISCARD_NONKEY;
+    if (avcodec_open2(*codec_ctx, codec, NULL) < 0) {
+        avcodec_free_context(codec_ctx);
+        avformat_close_input(fmt_ctx);
+        return -1;
+    }
+
+    *stream_index = index;
+    return 0;
+}
+
+/**
+ * Detect on the key frames of one recording that fall in the range
+ *
+ * @return 0 on success, -1 if the recording could not be read
+ */
+static int replay_recording(replay_lane_t *lane, const recording_metadata_t *recording) {
+    replay_job_t *job = lane->job;
+    AVFormatContext *fmt_ctx;
+    AVCodecContext *codec_ctx;
+    int stream_index;
+
+    if (open_recording(recording->file_path, &fmt_ctx, &codec_ctx, &stream_index) != 0) {
+        log_warn("[Stream %s] Failed to open recording %s for replay",
+                 job->request.stream_name, recording->file_path);
+        return -1;
+    }
+
+    AVPacket *pkt = av_packet_alloc();
+    AVFrame *frame = av_frame_alloc();
+    AVRational time_base = fmt_ctx->streams[stream_index]->time_base;
+    int64_t first_ts = AV_NOPTS_VALUE;
+    time_t last_sampled = 0;
+
+    while (pkt && frame && !atomic_load(&replay.cancel) && av_read_frame(fmt_ctx, pkt) >= 0) {
+        int64_t ts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+        if (pkt->stream_index != stream_index || ts == AV_NOPTS_VALUE) {
+            av_packet_unref(pkt);
+            continue;
+        }
+        if (first_ts == AV_NOPTS_VALUE) {
+            first_ts = ts;
+        }
+        if (!(pkt->flags & AV_PKT_FLAG_KEY)) {
+            av_packet_unref(pkt);
+            continue;
+        }
+
+        time_t frame_time = recording->start_time + (time_t)((double)(ts - first_ts) * av_q2d(time_base));
+        if (frame_time > job->request.end_time) {
+            av_packet_unref(pkt);
+            break;
+        }
+        if (frame_time < job->request.start_time ||
+            (last_sampled > 0 && frame_time - last_sampled < job->request.interval)) {
+            av_packet_unref(pkt);
+            continue;
+        }
+
+        // Each key frame is decoded on its own, like in live key frame mode
+        bool decoded = false;
+        if (avcodec_send_packet(codec_ctx, pkt) == 0) {
+            avcodec_send_packet(codec_ctx, NULL);
+            decoded = avcodec_receive_frame(codec_ctx, frame) == 0;
+        }
+        avcodec_flush_buffers(codec_ctx);
+        av_packet_unref(pkt);
+
+        if (decoded) {
+            last_sampled = frame_time;
+            lane->frame_count++;
+            if (lane->stream_id == STREAM_ID_INVALID ||
+                detection_scheduler_run(lane->stream_id, replay_frame_job, lane, frame,
+                                        lane->frame_count, frame_time) != 0) {
+                replay_frame_job(lane, frame, lane->frame_count, frame_time);
+            }
+            av_frame_unref(frame);
+        }
+    }
+
+    av_frame_free(&frame);
+    av_packet_free(&pkt);
+    avcodec_free_context(&codec_ctx);
+    avformat_close_input(&fmt_ctx);
+    return 0;
+}
+
+static void *replay_lane_thread(void *arg) {
+    replay_lane_t *lane = (replay_lane_t *)arg;
+    replay_job_t *job = lane->job;
+    recording_metadata_t recording;
+
+    thread_set_identity(THREAD_CLASS_DETECTION, "replay", job->request.stream_name);
+
+    while (next_recording(job, &recording)) {
+        int ret = replay_recording(lane, &recording);
+
+        // Footage is the part of the recording inside the range
+        time_t from = recording.start_time > job->request.start_time ? recording.start_time : job->request.start_time;
+        time_t to = recording.end_time < job->request.end_time ? recording.end_time : job->request.end_time;
+
+        pthread_mutex_lock(&replay.mutex);
+        if (ret == 0) {
+            replay.status.recordings++;
+            if (to > from) {
+                replay.status.footage_seconds += (double)(to - from);
+            }
+        } else {
+            replay.status.recordings_failed++;
+        }
+        pthread_mutex_unlock(&replay.mutex);
+    }
+
+    return NULL;
+}
+
+/**
+ * Run a prepared replay to the end and record how it went
+ */
+static void execute_job(replay_job_t *job) {
+    replay_lane_t lanes[REPLAY_MAX_LANES];
+    int lane_count = detection_scheduler_worker_count();
+    if (lane_count < 1) {
+        lane_count = 1;
+    } else if (lane_count > REPLAY_MAX_LANES) {
+        lane_count = REPLAY_MAX_LANES;
+    }
+
+    log_info("[Stream %s] Replaying detection from %ld to %ld with %s on %d lanes",
+             job->request.stream_name, (long)job->request.start_time, (long)job->request.end_time,
+             job->request.model_path, lane_count);
+
+    // Each lane has a model of its own; a SOD model shares one network between them
+    int started_lanes = 0;
+    for (int i = 0; i < lane_count; i++) {
+        replay_lane_t *lane = &lanes[i];
+        memset(lane, 0, sizeof(*lane));
+        lane->job = job;
+        lane->index = i;
+        lane->model = load_detection_model(job->request.model_path, job->request.threshold);
+        if (!lane->model) {
+            break;
+        }
+
+        // Without a free scheduler slot the lane detects on its own thread
+        char slot_name[MAX_STREAM_NAME];
+        snprintf(slot_name, sizeof(slot_name), "%.200s#replay%d", job->request.stream_name, i);
+        lane->stream_id = stream_registry_acquire(slot_name);
+
+        if (pthread_create(&lane->thread, NULL, replay_lane_thread, lane) != 0) {
+            if (lane->stream_id != STREAM_ID_INVALID) {
+                stream_registry_release(lane->stream_id);
+            }
+            unload_detection_model(lane->model);
+            break;
+        }
+        started_lanes++;
+    }
+
+    for (int i = 0; i < started_lanes; i++) {
+        pthread_join(lanes[i].thread, NULL);
+        if (lanes[i].stream_id != STREAM_ID_INVALID) {
+            stream_registry_release(lanes[i].stream_id);
+        }
+        unload_detection_model(lanes[i].model);
+        sws_freeContext(lanes[i].sws_ctx);
+        free(lanes[i].rgb_buffer);
+    }
+    pthread_mutex_destroy(&job->mutex);
+
+    pthread_mutex_lock(&replay.mutex);
+    detection_replay_status_t *status = &replay.status;
+    status->elapsed_seconds = seconds_since(&replay.started);
+    if (started_lanes == 0) {
+        status->state = DETECTION_REPLAY_FAILED;
+        snprintf(status->error, sizeof(status->error), "Failed to load model %s", job->request.model_path);
+    } else {
+        status->state = atomic_load(&replay.cancel) ? DETECTION_REPLAY_CANCELLED : DETECTION_REPLAY_DONE;
+    }
+    log_info("[Stream %s] Detection replay %s: %d recordings, %llu frames, %llu detections in %.1f s "
+             "(%.1f frames/s, %.0fx real time)",
+             job->request.stream_name, detection_replay_state_name(status->state), status->recordings,
+             (unsigned long long)status->frames, (unsigned long long)status->detections,
+             status->elapsed_seconds,
+             status->elapsed_seconds > 0 ? (double)status->frames / status->elapsed_seconds : 0.0,
+             status->elapsed_seconds > 0 ? status->footage_seconds / status->elapsed_seconds : 0.0);
+    pthread_mutex_unlock(&replay.mutex);
+}
+
+static void *replay_thread(void *arg) {
+    replay_job_t *job = (replay_job_t *)arg;
+    thread_set_identity(THREAD_CLASS_DETECTION, "replay", job->request.stream_name);
+    execute_job(job);
+    free(job);
+    return NULL;
+}
+
+/**
+ * Mark a replay as running, unless one already is
+ * Called with replay.mutex held.
+ */
+static int claim_replay(const replay_job_t *job, char *error, size_t error_size) {
+    if (replay.status.state == DETECTION_REPLAY_RUNNING) {
+        snprintf(error, error_size, "A replay is already running");
+        return -1;
+    }
+
+    // The thread of the last background replay has finished its work
+    if (replay.thread_started) {
+        pthread_join(replay.thread, NULL);
+        replay.thread_started = false;
+    }
+
+    memset(&replay.status, 0, sizeof(replay.status));
+    replay.status.state = DETECTION_REPLAY_RUNNING;
+    replay.status.request = job->request;
+    clock_gettime(CLOCK_MONOTONIC, &replay.started);
+    atomic_store(&replay.cancel, false);
+    return 0;
+}
+
+int detection_replay_start(const detection_replay_request_t *request, char *error, size_t error_size) {
+    char message[128] = "";
+    replay_job_t *job = malloc(sizeof(replay_job_t));
+    if (!job) {
+        snprintf(message, sizeof(message), "Out of memory");
+    } else if (prepare_job(request, job, message, sizeof(message)) == 0) {
+        pthread_mutex_lock(&replay.mutex);
+        if (claim_replay(job, message, sizeof(message)) == 0) {
+            if (pthread_create(&replay.thread, NULL, replay_thread, job) == 0) {
+                replay.thread_started = true;
+                pthread_mutex_unlock(&replay.mutex);
+                return 0;
+            }
+            replay.status.state = DETECTION_REPLAY_FAILED;
+            snprintf(message, sizeof(message), "Failed to start replay thread");
+            snprintf(replay.status.error, sizeof(replay.status.error), "%s", message);
+        }
+        pthread_mutex_unlock(&replay.mutex);
+        pthread_mutex_destroy(&job->mutex);
+    }
+
+    free(job);
+    if (error) {
+        snprintf(error, error_size, "%s", message);
+    }
+    return -1;
+}
+
+int detection_replay_run(const detection_replay_request_t *request, detection_replay_status_t *status) {
+    char message[128] = "";
+    replay_job_t *job = malloc(sizeof(replay_job_t));
+    int result = -1;
+
+    if (!job) {
+        snprintf(message, sizeof(message), "Out of memory");
+    } else if (prepare_job(request, job, message, sizeof(message)) == 0) {
+        pthread_mutex_lock(&replay.mutex);
+        int claimed = claim_replay(job, message, sizeof(message));
+        pthread_mutex_unlock(&replay.mutex);
+        if (claimed == 0) {
+            execute_job(job);
+        } else {
+            pthread_mutex_destroy(&job->mutex);
+        }
+    }
+    free(job);
+
+    pthread_mutex_lock(&replay.mutex);
+    if (message[0] != '\0') {
+        memset(status, 0, sizeof(*status));
+        status->state = DETECTION_REPLAY_FAILED;
+        status->request = *request;
+        snprintf(status->error, sizeof(status->error), "%s", message);
+    } else {
+        *status = replay.status;
+        result = status->state == DETECTION_REPLAY_DONE ? 0 : -1;
+    }
+    pthread_mutex_unlock(&replay.mutex);
+
+    return result;
+}
+
+void detection_replay_get_status(detection_replay_status_t *status) {
+    pthread_mutex_lock(&replay.mutex);
+    *status = replay.status;
+    if (status->state == DETECTION_REPLAY_RUNNING) {
+        status->elapsed_seconds = seconds_since(&replay.started);
+    }
+    pthread_mutex_unlock(&replay.mutex);
+}
+
+void detection_replay_cancel(void) {
+    atomic_store(&replay.cancel, true);
+}
+
+void detection_replay_shutdown(void) {
+    atomic_store(&replay.cancel, true);
+
+    pthread_mutex_lock(&replay.mutex);
+    bool started = replay.thread_started;
+    replay.thread_started = false;
+    pthread_t thread = replay.thread;
+    pthread_mutex_unlock(&replay.mutex);
+
+    if (started) {
+        pthread_join(thread, NULL);
+    }
+}
@@ -0,0 +1,513 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+
+#include <libavutil/frame.h>
+
+#include "core/logger.h"
+#include "core/config.h"
+#include "video/detection_scheduler.h"
+#include "video/load_governor.h"
+#include "video/thread_utils.h"
+
+// Upper bound on the worker pool, whatever the core count
+#define DETECTION_SCHEDULER_MAX_WORKERS 16
+
+// Idle jobs waiting at most; further submissions are refused
+#define DETECTION_SCHEDULER_MAX_IDLE_JOBS 1024
+
+// How often a worker looks again at idle jobs held back by load shedding
+#define IDLE_RETRY_MS 5000
+
+typedef struct {
+    detection_job_fn fn;
+    void *ctx;
+    AVFrame *frame;
+    int frame_count;
+    time_t timestamp;
+    bool pending;               // A job is waiting in the slot
+    bool running;               // A worker is running the previous job of this stream
+    uint64_t submitted;         // Sequence number of the newest job
+    uint64_t finished;          // Highest sequence number that ran or was dropped
+} job_slot_t;
+
+typedef struct {
+    detection_job_fn fn;
+    void *ctx;
+    AVFrame *frame;
+    int frame_count;
+    time_t timestamp;
+} dropped_job_t;
+
+typedef struct idle_job {
+    detection_idle_fn fn;
+    void *ctx;
+    struct idle_job *next;
+} idle_job_t;
+
+static job_slot_t slots[MAX_STREAMS];
+static pthread_t workers[DETECTION_SCHEDULER_MAX_WORKERS];
+static int worker_count = 0;
+static bool scheduler_running = false;
+static pthread_mutex_t scheduler_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_cond = PTHREAD_COND_INITIALIZER;   // Signaled when a job is queued or a token is due
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;   // Signaled when a job has run or been dropped
+
+// Slot the next worker starts scanning from, so streams are served round-robin
+static int next_slot = 0;
+
+// Background jobs in submission order; one runs at a time so detection always has workers
+static idle_job_t *idle_head = NULL;
+static idle_job_t *idle_tail = NULL;
+static int idle_count = 0;
+static bool idle_running = false;
+
+// Global frame budget as a token bucket refilled at max_fps
+static int budget_fps = 0;
+static double budget_tokens = 0.0;
+static int64_t budget_refill_ms = 0;
+
+static int64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * Take the pending job out of a slot, with the scheduler mutex held
+ * The caller runs finish_dropped_job on it once the mutex is released.
+ */
+static bool take_pending_job(job_slot_t *slot, dropped_job_t *dropped) {
+    if (!slot->pending) {
+        return false;
+    }
+
+    dropped->fn = slot->fn;
+    dropped->ctx = slot->ctx;
+    dropped->frame = slot->frame;
+    dropped->frame_count = slot->frame_count;
+    dropped->timestamp = slot->timestamp;
+
+    slot->frame = NULL;
+    slot->pending = false;
+    if (slot->finished < slot->submitted) {
+        slot->finished = slot->submitted;
+    }
+    pthread_cond_broadcast(&done_cond);
+    return true;
+}
+
+/**
+ * Tell the owner of a dropped job and free its frame, without the mutex held
+ */
+static void finish_dropped_job(dropped_job_t *dropped) {
+    if (dropped->fn) {
+        dropped->fn(dropped->ctx, NULL, dropped->frame_count, dropped->timestamp);
+    }
+    av_frame_free(&dropped->frame);
+}
+
+/**
+ * Find the next slot with a job no worker is running, starting after the
+ * slot served last
+ *
+ * @return Slot index, or -1 if there is nothing to run
+ */
+static int find_runnable_slot(void) {
+    for (int n = 0; n < MAX_STREAMS; n++) {
+        int i = (next_slot + n) % MAX_STREAMS;
+        if (slots[i].pending && !slots[i].running) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Take a token from the frame budget, with the scheduler mutex held
+ *
+ * @return 0 if a token was taken, otherwise milliseconds until the next one
+ */
+static int64_t take_budget_token(void) {
+    if (budget_fps <= 0) {
+        return 0;
+    }
+
+    int64_t now = now_ms();
+    budget_tokens += (double)(now - budget_refill_ms) * budget_fps / 1000.0;
+    budget_refill_ms = now;
+    if (budget_tokens > budget_fps) {
+        budget_tokens = budget_fps;
+    }
+
+    if (budget_tokens >= 1.0) {
+        budget_tokens -= 1.0;
+        return 0;
+    }
+
+    int64_t wait_ms = (int64_t)((1.0 - budget_tokens) * 1000.0 / budget_fps) + 1;
+    return wait_ms;
+}
+
+static void wait_ms_locked(int64_t ms) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += ms / 1000;
+    deadline.tv_nsec += (ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    pthread_cond_timedwait(&work_cond, &scheduler_mutex, &deadline);
+}
+
+/**
+ * Run the oldest idle job, with the scheduler mutex held
+ * The mutex is released while the job runs.
+ */
+static void run_idle_job_locked(void) {
+    idle_job_t *job = idle_head;
+    idle_head = job->next;
+    if (!idle_head) {
+        idle_tail = NULL;
+    }
+    idle_count--;
+    idle_running = true;
+    pthread_mutex_unlock(&scheduler_mutex);
+
+    job->fn(job->ctx, false);
+    free(job);
+
+    pthread_mutex_lock(&scheduler_mutex);
+    idle_running = false;
+    if (idle_head) {
+        pthread_cond_signal(&work_cond);
+    }
+}
+
+static void *detection_worker(void *arg) {
+    (void)arg;
+    thread_set_identity(THREAD_CLASS_DETECTION, "det-worker", NULL);
+
+    pthread_mutex_lock(&scheduler_mutex);
+    while (scheduler_running) {
+        int i = find_runnable_slot();
+        if (i < 0) {
+            if (idle_head && !idle_running) {
+                if (load_governor_level() != LOAD_SHED_NONE) {
+                    wait_ms_locked(IDLE_RETRY_MS);
+                    continue;
+                }
+                run_idle_job_locked();
+                continue;
+            }
+            pthread_cond_wait(&work_cond, &scheduler_mutex);
+            continue;
+        }
+
+        int64_t wait = take_budget_token();
+        if (wait > 0) {
+            wait_ms_locked(wait);
+            continue;
+        }
+
+        job_slot_t *slot = &slots[i];
+        detection_job_fn fn = slot->fn;
+        void *ctx = slot->ctx;
+        AVFrame *frame = slot->frame;
+        int frame_count = slot->frame_count;
+        time_t timestamp = slot->timestamp;
+        uint64_t sequence = slot->submitted;
+
+        slot->frame = NULL;
+        slot->pending = false;
+        slot->running = true;
+        next_slot = (i + 1) % MAX_STREAMS;
+        pthread_mutex_unlock(&scheduler_mutex);
+
+        fn(ctx, frame, frame_count, timestamp);
+        av_frame_free(&frame);
+
+        pthread_mutex_lock(&scheduler_mutex);
+        slot->running = false;
+        if (slot->finished < sequence) {
+            slot->finished = sequence;
+        }
+        pthread_cond_broadcast(&done_cond);
+
+        // A newer frame of this stream may have been queued meanwhile
+        if (slot->pending) {
+            pthread_cond_signal(&work_cond);
+        }
+    }
+    pthread_mutex_unlock(&scheduler_mutex);
+    return NULL;
+}
+
+/**
+ * Initialize the detection scheduler
+ */
+int detection_scheduler_init(int workers_requested, int max_fps) {
+    pthread_mutex_lock(&scheduler_mutex);
+    if (scheduler_running) {
+        pthread_mutex_unlock(&scheduler_mutex);
+        return 0;
+    }
+
+    int count = workers_requested;
+    if (count <= 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        count = cores > 1 ? (int)cores - 1 : 1;
+    }
+    if (count > DETECTION_SCHEDULER_MAX_WORKERS) {
+        count = DETECTION_SCHEDULER_MAX_WORKERS;
+    }
+
+    memset(slots, 0, sizeof(slots));
+    next_slot = 0;
+    idle_running = false;
+    budget_fps = max_fps > 0 ? max_fps : 0;
+    budget_tokens = budget_fps;
+    budget_refill_ms = now_ms();
+    scheduler_running = true;
+
+    worker_count = 0;
+    for (int i = 0; i < count; i++) {
+        if (pthread_create(&workers[i], NULL, detection_worker, NULL) != 0) {
+            log_error("Failed to create detection worker %d", i);
+            break;
+        }
+        worker_count++;
+    }
+
+    if (worker_count == 0) {
+        scheduler_running = false;
+        pthread_mutex_unlock(&scheduler_mutex);
+        return -1;
+    }
+    pthread_mutex_unlock(&scheduler_mutex);
+
+    if (budget_fps > 0) {
+        log_info("Detection scheduler started with %d workers, limited to %d frames per second",
+                 worker_count, budget_fps);
+    } else {
+        log_info("Detection scheduler started with %d workers", worker_count);
+    }
+    return 0;
+}
+
+/**
+ * Shutdown the detection scheduler
+ */
+void detection_scheduler_shutdown(void) {
+    pthread_mutex_lock(&scheduler_mutex);
+    if (!scheduler_running) {
+        pthread_mutex_unlock(&scheduler_mutex);
+        return;
+    }
+    scheduler_running = false;
+    pthread_cond_broadcast(&work_cond);
+    pthread_mutex_unlock(&scheduler_mutex);
+
+    // Workers finish the job they are running before they exit
+    for (int i = 0; i < worker_count; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    worker_count = 0;
+
+    for (int i = 0; i < MAX_STREAMS; i++) {
+        dropped_job_t dropped;
+        pthread_mutex_lock(&scheduler_mutex);
+        bool have_dropped = take_pending_job(&slots[i], &dropped);
+        pthread_mutex_unlock(&scheduler_mutex);
+        if (have_dropped) {
+            finish_dropped_job(&dropped);
+        }
+    }
+
+    pthread_mutex_lock(&scheduler_mutex);
+    idle_job_t *idle = idle_head;
+    idle_head = NULL;
+    idle_tail = NULL;
+    idle_count = 0;
+    pthread_mutex_unlock(&scheduler_mutex);
+    while (idle) {
+        idle_job_t *next = idle->next;
+        idle->fn(idle->ctx, true);
+        free(idle);
+        idle = next;
+    }
+
+    log_info("Detection scheduler stopped");
+}
+
+/**
+ * Queue a job, replacing the pending one of the stream
+ *
+ * @param sequence Receives the sequence number of the job
+ */
+static int queue_job(int stream_id, detection_job_fn fn, void *ctx, const AVFrame *frame,
+                     int frame_count, time_t timestamp, uint64_t *sequence) {
+    if (stream_id < 0 || stream_id >= MAX_STREAMS || !fn || !frame) {
+        return -1;
+    }
+
+    AVFrame *ref = av_frame_alloc();
+    if (!ref) {
+        return -1;
+    }
+    if (av_frame_ref(ref, frame) < 0) {
+        av_frame_free(&ref);
+        return -1;
+    }
+
+    pthread_mutex_lock(&scheduler_mutex);
+    if (!scheduler_running) {
+        pthread_mutex_unlock(&scheduler_mutex);
+        av_frame_free(&ref);
+        return -1;
+    }
+
+    // Detection only ever needs the newest frame of a stream
+    job_slot_t *slot = &slots[stream_id];
+    dropped_job_t dropped;
+    bool have_dropped = take_pending_job(slot, &dropped);
+
+    slot->fn = fn;
+    slot->ctx = ctx;
+    slot->frame = ref;
+    slot->frame_count = frame_count;
+    slot->timestamp = timestamp;
+    slot->pending = true;
+    slot->submitted++;
+    if (sequence) {
+        *sequence = slot->submitted;
+    }
+
+    pthread_cond_signal(&work_cond);
+    pthread_mutex_unlock(&scheduler_mutex);
+
+    if (have_dropped) {
+        log_debug("Replaced pending detection of frame %d with frame %d",
+                  dropped.frame_count, frame_count);
+        finish_dropped_job(&dropped);
+    }
+    return 0;
+}
+
+/**
+ * Queue a frame of a stream for detection
+ */
+int detection_scheduler_submit(int stream_id, detection_job_fn fn, void *ctx, const AVFrame *frame,
+                               int frame_count, time_t timestamp) {
+    return queue_job(stream_id, fn, ctx, frame, frame_count, timestamp, NULL);
+}
+
+/**
+ * Queue a frame and wait until its detection has finished
+ */
+int detection_scheduler_run(int stream_id, detection_job_fn fn, void *ctx, const AVFrame *frame,
+                            int frame_count, time_t timestamp) {
+    uint64_t sequence = 0;
+    if (queue_job(stream_id, fn, ctx, frame, frame_count, timestamp, &sequence) != 0) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&scheduler_mutex);
+    while (slots[stream_id].finished < sequence) {
+        pthread_cond_wait(&done_cond, &scheduler_mutex);
+    }
+    pthread_mutex_unlock(&scheduler_mutex);
+    return 0;
+}
+
+/**
+ * Queue a background job for when the workers are idle
+ */
+int detection_scheduler_submit_idle(detection_idle_fn fn, void *ctx) {
+    if (!fn) {
+        return -1;
+    }
+
+    idle_job_t *job = calloc(1, sizeof(idle_job_t));
+    if (!job) {
+        return -1;
+    }
+    job->fn = fn;
+    job->ctx = ctx;
+
+    pthread_mutex_lock(&scheduler_mutex);
+    if (!scheduler_running || idle_count >= DETECTION_SCHEDULER_MAX_IDLE_JOBS) {
+        pthread_mutex_unlock(&scheduler_mutex);
+        free(job);
+        return -1;
+    }
+    if (idle_tail) {
+        idle_tail->next = job;
+    } else {
+        idle_head = job;
+    }
+    idle_tail = job;
+    idle_count++;
+    pthread_cond_signal(&work_cond);
+    pthread_mutex_unlock(&scheduler_mutex);
+    return 0;
+}
+
+/**
+ * Drop the pending job of a stream and wait for its running job
+ */
+void detection_scheduler_cancel(int stream_id) {
+    if (stream_id < 0 || stream_id >= MAX_STREAMS) {
+        return;
+    }
+
+    job_slot_t *slot = &slots[stream_id];
+    dropped_job_t dropped;
+
+    pthread_mutex_lock(&scheduler_mutex);
+    bool have_dropped = take_pending_job(slot, &dropped);
+    pthread_mutex_unlock(&scheduler_mutex);
+
+    if (have_dropped) {
+        finish_dropped_job(&dropped);
+    }
+
+    pthread_mutex_lock(&scheduler_mutex);
+    while (slot->running) {
+        pthread_cond_wait(&done_cond, &scheduler_mutex);
+    }
+    pthread_mutex_unlock(&scheduler_mutex);
+}
+
+/**
+ * Number of running workers
+ */
+int detection_scheduler_worker_count(void) {
+    pthread_mutex_lock(&scheduler_mutex);
+    int count = scheduler_running ? worker_count : 0;
+    pthread_mutex_unlock(&scheduler_mutex);
+    return count;
+}
+
+/**
+ * Number of jobs queued or running across all streams
+ */
+int detection_scheduler_active_jobs(void) {
+    int count = 0;
+    pthread_mutex_lock(&scheduler_mutex);
+    for (int i = 0; i < MAX_STREAMS; i++) {
+        if (slots[i].pending || slots[i].running) {
+            count++;
+        }
+    }
+    pthread_mutex_unlock(&scheduler_mutex);
+    return count;
+}
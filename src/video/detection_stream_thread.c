@@ -8,6 +8,7 @@
 #include <sys/stat.h>
 #include <dirent.h>
 #include <time.h>
+#include <math.h>
 #include <stdatomic.h>
 #include <curl/curl.h>
 #include <errno.h>
@@ -16,42 +17,141 @@
 #include <libavcodec/avcodec.h>
 #include <libavutil/avutil.h>
 #include <libavutil/imgutils.h>
+#include <libavutil/motion_vector.h>
+#include <libavutil/pixdesc.h>
 #include <libswscale/swscale.h>
 
 #include "core/logger.h"
 #include "core/config.h"
+#include "core/device_profile.h"
 #include "core/shutdown_coordinator.h"
 #include "utils/strings.h"
+#include "utils/memory.h"
 #include "video/detection_stream_thread.h"
 #include "video/detection_stream_thread_helpers.h"
 #include "video/detection_model.h"
 #include "video/sod_integration.h"
 #include "video/detection_result.h"
 #include "video/detection_recording.h"
+#include "video/sod_detection.h"
 #include "video/detection_embedded.h"
+#include "video/detection_scheduler.h"
+#include "video/detection_replay.h"
+#include "video/motion_detection.h"
 #include "video/streams.h"
 #include "video/hls_writer.h"
 #include "video/hls/hls_unified_thread.h"
+#include "video/hls/hls_segment_index.h"
 #include "video/api_detection.h"
 #include "video/onvif_detection.h"
+#include "video/remote_detection.h"
+#include "video/frame_export.h"
+#include "video/snapshot_cache.h"
+#include "video/object_tracker.h"
 #include "video/go2rtc/go2rtc_stream.h"
+#include "video/go2rtc/go2rtc_integration.h"
+#include "video/stream_ingest.h"
+#include "video/hw_decode.h"
+#include "video/thread_utils.h"
+#include "database/db_streams.h"
+#include "video/stream_registry.h"
+#include "core/event_bus.h"
 
 // Add signal handler to catch floating point exceptions
 #include <fenv.h>
 #include <signal.h>
 #include <unistd.h>
 
-// Array of stream detection threads
-static stream_detection_thread_t stream_threads[MAX_STREAM_THREADS] = {0};
+// Array of stream detection threads, indexed by stream registry ID
+static stream_detection_thread_t *stream_threads = NULL;
+static int thread_capacity = 0;
 static pthread_mutex_t stream_threads_mutex = PTHREAD_MUTEX_INITIALIZER;
 static bool system_initialized = false;
 
+/**
+ * Find the running detection thread of a stream
+ * Must be called with stream_threads_mutex held.
+ *
+ * @return Slot of the thread, or -1 if no thread is running for the stream
+ */
+static int find_stream_thread_slot(const char *stream_name) {
+    int slot = stream_registry_lookup(stream_name);
+    if (slot < 0 || slot >= thread_capacity) {
+        return -1;
+    }
+
+    if (!stream_threads[slot].running || strcmp(stream_threads[slot].stream_name, stream_name) != 0) {
+        return -1;
+    }
+    return slot;
+}
+
+// Seconds before a model that failed to reload is tried again
+#define MODEL_RELOAD_RETRY_SEC 30
+
+// Models used more recently than this are kept even over the memory budget,
+// so a budget too small for the active streams does not reload them constantly
+#define MODEL_EVICT_MIN_IDLE_SEC 60
+
+/**
+ * Make sure the thread's model is loaded, loading it again after an eviction
+ * Called with the thread mutex held.
+ */
+static bool ensure_stream_model(stream_detection_thread_t *thread) {
+    time_t now = time(NULL);
+    if (!thread->model) {
+        if (thread->model_path[0] == '\0' || now < thread->model_retry_at) {
+            return false;
+        }
+
+        log_info("[Stream %s] Loading detection model: %s", thread->stream_name, thread->model_path);
+        thread->model = load_detection_model(thread->model_path, thread->threshold);
+        if (!thread->model) {
+            log_error("[Stream %s] Failed to load detection model: %s",
+                     thread->stream_name, thread->model_path);
+            thread->model_retry_at = now + MODEL_RELOAD_RETRY_SEC;
+            return false;
+        }
+        log_info("[Stream %s] Successfully loaded detection model", thread->stream_name);
+    }
+
+    thread->model_last_used = now;
+    return true;
+}
+
+// Queue depth for the live detection consumer; detection samples at most a
+// few frames per second, so there is no point in holding on to many GOPs
+#define LIVE_DETECTION_QUEUE_DEPTH 128
+
+// With packet_activity_gate, how long decoding goes on after the packet sizes
+// of a stream last stood out, and how often a quiet stream's key frame is
+// still checked when detection_interval_max is 0
+#define PACKET_ACTIVITY_HOLD_MS 10000
+#define PACKET_ACTIVITY_QUIET_CHECK_SEC 30
+
 // Global variable for startup delay (defined here since it's extern in the header)
 time_t global_startup_delay_end = 0;
 
 // Forward declarations for functions from other modules
 int detect_objects(detection_model_t model, const uint8_t *frame_data, int width, int height, int channels, detection_result_t *result);
-int process_frame_for_recording(const char *stream_name, const uint8_t *frame_data, int width, int height, int channels, time_t timestamp, detection_result_t *result);
+
+/**
+ * Publish the results of a frame to whatever acts on them: detection-based
+ * recording and the database, and the live overlays
+ * Frames with nothing found are published too, so the overlays clear.
+ */
+static void publish_detections(const stream_detection_thread_t *thread, const detection_result_t *result,
+                               time_t timestamp, int64_t pts) {
+    bus_event_t event = {
+        .type = BUS_EVENT_DETECTION,
+        .time = timestamp,
+        .pts = pts,
+        .threshold = thread->threshold,
+        .result = *result,
+    };
+    snprintf(event.stream_name, sizeof(event.stream_name), "%s", thread->stream_name);
+    event_bus_publish(&event);
+}
 
 /**
  * Process a frame directly for detection
@@ -67,13 +167,8 @@ int process_frame_for_stream_detection(const char *stream_name, const uint8_t *f
     pthread_mutex_lock(&stream_threads_mutex);
 
     // Find the thread for this stream
-    stream_detection_thread_t *thread = NULL;
-    for (int i = 0; i < MAX_STREAM_THREADS; i++) {
-        if (stream_threads[i].running && strcmp(stream_threads[i].stream_name, stream_name) == 0) {
-            thread = &stream_threads[i];
-            break;
-        }
-    }
+    int slot = find_stream_thread_slot(stream_name);
+    stream_detection_thread_t *thread = slot >= 0 ? &stream_threads[slot] : NULL;
 
     if (!thread) {
         log_warn("No detection thread found for stream %s", stream_name);
@@ -84,20 +179,17 @@ int process_frame_for_stream_detection(const char *stream_name, const uint8_t *f
     // Check if a detection is already in progress
     int detection_running = atomic_load(&thread->detection_in_progress);
     if (detection_running) {
-        log_info("[Stream %s] Detection already in progress, skipping frame", thread->stream_name);
+        log_debug("[Stream %s] Detection already in progress, skipping frame", thread->stream_name);
         pthread_mutex_unlock(&stream_threads_mutex);
         return 0;
     }
 
     // Check if enough time has passed since the last detection
     time_t current_time = time(NULL);
-    if (thread->last_detection_time > 0) {
-        time_t time_since_last = current_time - thread->last_detection_time;
-        if (time_since_last < thread->detection_interval) {
-            // Not enough time has passed, skip this frame
-            pthread_mutex_unlock(&stream_threads_mutex);
-            return 0;
-        }
+    if (!detection_interval_elapsed(thread, current_time)) {
+        // Not enough time has passed, skip this frame
+        pthread_mutex_unlock(&stream_threads_mutex);
+        return 0;
     }
 
     // Set the atomic flag to indicate a detection is in progress
@@ -121,68 +213,54 @@ int process_frame_for_stream_detection(const char *stream_name, const uint8_t *f
     pthread_mutex_lock(&thread->mutex);
 
     // Make sure the model is loaded
-    if (!thread->model) {
-        log_info("[Stream %s] Loading detection model: %s", thread->stream_name, thread->model_path);
-        thread->model = load_detection_model(thread->model_path, thread->threshold);
-        if (!thread->model) {
-            log_error("[Stream %s] Failed to load detection model: %s",
-                     thread->stream_name, thread->model_path);
-            pthread_mutex_unlock(&thread->mutex);
-            pthread_mutex_unlock(&stream_threads_mutex);
-            // Don't return error, just indicate no detections were found
-            log_info("[Stream %s] Continuing detection thread despite model loading failure", thread->stream_name);
-            return 0;
-        }
-        log_info("[Stream %s] Successfully loaded detection model", thread->stream_name);
+    if (!ensure_stream_model(thread)) {
+        atomic_store(&thread->detection_in_progress, 0);
+        pthread_mutex_unlock(&thread->mutex);
+        pthread_mutex_unlock(&stream_threads_mutex);
+        // Don't return error, just indicate no detections were found
+        return 0;
     }
 
     // Run detection
-    log_info("[Stream %s] Running detection on frame (dimensions: %dx%d, channels: %d)",
+    log_debug("[Stream %s] Running detection on frame (dimensions: %dx%d, channels: %d)",
             thread->stream_name, width, height, channels);
 
+    uint64_t detect_started_us = metrics_now_us();
     detect_ret = detect_objects(thread->model, frame_data, width, height, channels, &result);
+    metrics_observe_since(thread->latency_metric, detect_started_us);
 
     pthread_mutex_unlock(&thread->mutex);
 
     if (detect_ret != 0) {
         // Handle detection errors
-        log_error("[Stream %s] Detection failed (error code: %d)", thread->stream_name, detect_ret);
+        log_error_ratelimited("[Stream %s] Detection failed (error code: %d)", thread->stream_name, detect_ret);
 
         // Set result.count to 0 to indicate no detections
         result.count = 0;
 
         // Continue processing despite the error
-        log_info("[Stream %s] Continuing detection thread despite detection failure", thread->stream_name);
+        log_debug("[Stream %s] Continuing detection thread despite detection failure", thread->stream_name);
 
         // Don't return here, continue processing with empty results
     }
 
     // Process detection results
     if (result.count > 0) {
-        log_info("[Stream %s] Detection found %d objects", thread->stream_name, result.count);
+        log_debug("[Stream %s] Detection found %d objects", thread->stream_name, result.count);
 
         // Log each detected object
         for (int i = 0; i < result.count && i < MAX_DETECTIONS; i++) {
-            log_info("[Stream %s] Object %d: class=%s, confidence=%.2f, box=[%.2f,%.2f,%.2f,%.2f]",
+            log_debug("[Stream %s] Object %d: class=%s, confidence=%.2f, box=[%.2f,%.2f,%.2f,%.2f]",
                     thread->stream_name, i, result.detections[i].label,
                     result.detections[i].confidence,
                     result.detections[i].x, result.detections[i].y,
                     result.detections[i].width, result.detections[i].height);
         }
-
-        // Process the detection results for recording
-        int record_ret = process_frame_for_recording(thread->stream_name, frame_data, width, height,
-                                                   channels, timestamp, &result);
-
-        if (record_ret != 0) {
-            log_error("[Stream %s] Failed to process frame for recording (error code: %d)",
-                     thread->stream_name, record_ret);
-        } else {
-            log_info("[Stream %s] Successfully processed frame for recording", thread->stream_name);
-        }
     } else {
         log_debug("[Stream %s] No objects detected in frame", thread->stream_name);
     }
+    publish_detections(thread, &result, timestamp, -1);
+    update_detection_interval(thread, current_time, result.count > 0);
 
     // Clear the atomic flag to indicate detection is complete
     atomic_store(&thread->detection_in_progress, 0);
@@ -191,8 +269,572 @@ int process_frame_for_stream_detection(const char *stream_name, const uint8_t *f
     return 0;
 }
 
+// Frames keep passing the motion gate this long after motion, matching the
+// motion detector's cooldown during which it does not report again
+#define MOTION_GATE_HOLD_SECONDS 3
 
-// Forward declarations for functions from other modules
+// Margin added around the moving region, as a fraction of the frame
+#define MOTION_REGION_MARGIN 0.05f
+
+// Regions covering more of the frame than this are not worth cropping
+#define MOTION_REGION_MAX_AREA 0.75f
+
+// Smallest crop in pixels, so the model still gets some context
+#define MOTION_REGION_MIN_SIZE 64
+
+/**
+ * Run the motion detector on the luma plane of a frame to decide whether the
+ * model should look at it
+ * When the decoder exports motion vectors, predicted frames are judged by
+ * their vectors instead and only key frames go through the luma plane.
+ * Frames the motion detector cannot handle are let through, so a gated
+ * stream never detects less than an ungated one would for lack of motion
+ * data.
+ *
+ * @param thread Detection thread
+ * @param frame Software frame
+ * @param frame_timestamp Wall-clock time of the frame
+ * @param region Receives the region of the motion, normalized
+ * @return true if object detection should run on the frame
+ */
+static bool motion_gate_open(stream_detection_thread_t *thread, const AVFrame *frame,
+                             time_t frame_timestamp, detection_t *region) {
+    detection_result_t motion;
+    memset(&motion, 0, sizeof(motion));
+
+    if (thread->motion_vectors && frame->pict_type != AV_PICTURE_TYPE_I) {
+        // A predicted frame without vectors is all intra blocks
+        const AVFrameSideData *sd = av_frame_get_side_data(frame, AV_FRAME_DATA_MOTION_VECTORS);
+        if (detect_motion_vectors(thread->stream_name, sd ? (const AVMotionVector *)sd->data : NULL,
+                                  sd ? (int)(sd->size / sizeof(AVMotionVector)) : 0,
+                                  frame->width, frame->height, frame_timestamp, &motion) != 0) {
+            return true;
+        }
+    } else {
+        const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(frame->format);
+        if (!desc || (desc->flags & (AV_PIX_FMT_FLAG_RGB | AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_HWACCEL)) ||
+            desc->comp[0].plane != 0 || desc->comp[0].step != 1 || desc->comp[0].depth != 8) {
+            log_debug("[Stream %s] No 8-bit luma plane in %s frames, motion gate open",
+                     thread->stream_name, desc ? desc->name : "unknown");
+            return true;
+        }
+
+        if (detect_motion_luma(thread->stream_name, frame->data[0], frame->linesize[0],
+                               frame->width, frame->height, frame_timestamp, &motion) != 0) {
+            return true;
+        }
+    }
+
+    if (motion.count > 0) {
+        thread->motion_hold_until = frame_timestamp + MOTION_GATE_HOLD_SECONDS;
+        thread->motion_region = motion.detections[0];
+
+        bus_event_t event = {
+            .type = BUS_EVENT_MOTION,
+            .time = frame_timestamp,
+            .pts = frame->pts != AV_NOPTS_VALUE ? frame->pts : -1,
+            .threshold = thread->threshold,
+            .result = motion,
+        };
+        snprintf(event.stream_name, sizeof(event.stream_name), "%s", thread->stream_name);
+        event_bus_publish(&event);
+    } else if (frame_timestamp >= thread->motion_hold_until) {
+        return false;
+    }
+
+    *region = thread->motion_region;
+    return true;
+}
+
+/**
+ * Intersect a region with another
+ *
+ * @param region Region, normalized; receives the intersection
+ * @param other Other region, normalized
+ * @return false if the regions do not overlap
+ */
+static bool intersect_region(detection_t *region, const detection_t *other) {
+    float x0 = fmaxf(region->x, other->x);
+    float y0 = fmaxf(region->y, other->y);
+    float x1 = fminf(region->x + region->width, other->x + other->width);
+    float y1 = fminf(region->y + region->height, other->y + other->height);
+    if (x1 <= x0 || y1 <= y0) {
+        return false;
+    }
+
+    region->x = x0;
+    region->y = y0;
+    region->width = x1 - x0;
+    region->height = y1 - y0;
+    return true;
+}
+
+/**
+ * Point the planes of a frame at a region (the motion, the detection zones)
+ * plus a margin
+ * The crop is aligned to the chroma subsampling of the format.
+ *
+ * @param frame Software frame
+ * @param region Region to keep, normalized
+ * @param crop Receives the crop rectangle in pixels (x, y, width, height)
+ * @param data Receives the plane pointers of the crop
+ * @return true if the frame is cropped, false to process the whole frame
+ */
+static bool crop_to_region(const AVFrame *frame, const detection_t *region,
+                           int crop[4], const uint8_t *data[4]) {
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(frame->format);
+    if (!desc || (desc->flags & (AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_BITSTREAM)) ||
+        region->width * region->height > MOTION_REGION_MAX_AREA) {
+        return false;
+    }
+
+    float x0 = fmaxf(region->x - MOTION_REGION_MARGIN, 0.0f);
+    float y0 = fmaxf(region->y - MOTION_REGION_MARGIN, 0.0f);
+    float x1 = fminf(region->x + region->width + MOTION_REGION_MARGIN, 1.0f);
+    float y1 = fminf(region->y + region->height + MOTION_REGION_MARGIN, 1.0f);
+
+    int align_x = 1 << (desc->log2_chroma_w > 1 ? desc->log2_chroma_w : 1);
+    int align_y = 1 << (desc->log2_chroma_h > 1 ? desc->log2_chroma_h : 1);
+
+    int x = ((int)(x0 * frame->width)) & ~(align_x - 1);
+    int y = ((int)(y0 * frame->height)) & ~(align_y - 1);
+    int width = ((int)ceilf(x1 * frame->width) - x) & ~1;
+    int height = ((int)ceilf(y1 * frame->height) - y) & ~1;
+
+    if (width < MOTION_REGION_MIN_SIZE) {
+        width = MOTION_REGION_MIN_SIZE < frame->width ? MOTION_REGION_MIN_SIZE : frame->width;
+        if (x + width > frame->width) {
+            x = (frame->width - width) & ~(align_x - 1);
+        }
+    }
+    if (height < MOTION_REGION_MIN_SIZE) {
+        height = MOTION_REGION_MIN_SIZE < frame->height ? MOTION_REGION_MIN_SIZE : frame->height;
+        if (y + height > frame->height) {
+            y = (frame->height - height) & ~(align_y - 1);
+        }
+    }
+
+    for (int i = 0; i < 4; i++) {
+        data[i] = frame->data[i];
+    }
+    for (int c = 0; c < desc->nb_components; c++) {
+        const AVComponentDescriptor *comp = &desc->comp[c];
+        bool chroma = (c == 1 || c == 2) && !(desc->flags & AV_PIX_FMT_FLAG_RGB);
+        int px = chroma ? x >> desc->log2_chroma_w : x;
+        int py = chroma ? y >> desc->log2_chroma_h : y;
+        data[comp->plane] = frame->data[comp->plane] + (ptrdiff_t)py * frame->linesize[comp->plane] + px * comp->step;
+    }
+
+    crop[0] = x;
+    crop[1] = y;
+    crop[2] = width;
+    crop[3] = height;
+    return true;
+}
+
+/**
+ * Describe a YUV 4:2:0 frame, or the cropped part of it, for the model input kernels
+ *
+ * @param frame Software frame
+ * @param data Planes of the part to describe (see crop_to_region)
+ * @param width Width of the part
+ * @param height Height of the part
+ * @param yuv Filled with the planes
+ * @return true if the frame is YUV420P, YUVJ420P, NV12 or NV21
+ */
+static bool frame_to_yuv420(const AVFrame *frame, const uint8_t *const data[4], int width, int height,
+                            yuv420_image_t *yuv) {
+    yuv->y = data[0];
+    yuv->y_stride = frame->linesize[0];
+    yuv->width = width;
+    yuv->height = height;
+    yuv->full_range = frame->format == AV_PIX_FMT_YUVJ420P || frame->color_range == AVCOL_RANGE_JPEG;
+
+    switch (frame->format) {
+        case AV_PIX_FMT_YUV420P:
+        case AV_PIX_FMT_YUVJ420P:
+            yuv->u = data[1];
+            yuv->v = data[2];
+            yuv->uv_stride = frame->linesize[1];
+            yuv->uv_step = 1;
+            return true;
+        case AV_PIX_FMT_NV12:
+            yuv->u = data[1];
+            yuv->v = data[1] + 1;
+            yuv->uv_stride = frame->linesize[1];
+            yuv->uv_step = 2;
+            return true;
+        case AV_PIX_FMT_NV21:
+            yuv->v = data[1];
+            yuv->u = data[1] + 1;
+            yuv->uv_stride = frame->linesize[1];
+            yuv->uv_step = 2;
+            return true;
+        default:
+            return false;
+    }
+}
+
+/**
+ * Convert a decoded frame to RGB, run the stream's model on it and hand any
+ * detections to the recording logic
+ * SOD models on YUV 4:2:0 frames skip the RGB frame: the frame is converted
+ * straight into the input tensor of the network.
+ * With the motion gate on, frames without motion are dropped before the
+ * conversion, and in region mode only the part that moved is converted.
+ * With detection zones, only their bounding box is converted and detections
+ * outside the zones are dropped.
+ *
+ * @param thread Detection thread
+ * @param decoded Decoded video frame (software or hardware)
+ * @param frame_count Frame number (for logging)
+ * @param frame_timestamp Wall-clock time of the frame
+ * @return 0 on success, -1 on failure
+ */
+static int detect_decoded_frame(stream_detection_thread_t *thread, const AVFrame *decoded,
+                                int frame_count, time_t frame_timestamp) {
+    // Frames from a hardware decoder are downloaded first; the RGB conversion
+    // below scales straight to the model's input size
+    AVFrame *sw_frame = decoded->hw_frames_ctx ? packet_pool_get_frame(thread->packet_pool) : NULL;
+    const AVFrame *frame = hw_decode_get_sw_frame(decoded, sw_frame);
+    if (!frame) {
+        packet_pool_put_frame(thread->packet_pool, &sw_frame);
+        return -1;
+    }
+
+    // External analytics read the frame from shared memory, motion or not
+    frame_export_publish(thread->stream_name, frame);
+
+    // The last detection time is left alone, so the next sampled frame is checked again
+    detection_t motion_region = {.x = 0.0f, .y = 0.0f, .width = 1.0f, .height = 1.0f};
+    if (thread->motion_gate != MOTION_GATE_OFF &&
+        !motion_gate_open(thread, frame, frame_timestamp, &motion_region)) {
+        log_debug("[Stream %s] No motion in frame %d, skipping object detection",
+                 thread->stream_name, frame_count);
+        update_detection_interval(thread, time(NULL), false);
+        packet_pool_put_frame(thread->packet_pool, &sw_frame);
+        return 0;
+    }
+
+    // The model looks at the zones only, in region mode at the part of them that moved
+    detection_t crop_region = {.x = 0.0f, .y = 0.0f, .width = 1.0f, .height = 1.0f};
+    bool crop_wanted = false;
+    if (thread->motion_gate == MOTION_GATE_REGION) {
+        crop_region = motion_region;
+        crop_wanted = true;
+    }
+    detection_t zone_bounds;
+    if (detection_zones_bounds(thread->zones, thread->zone_count, &zone_bounds)) {
+        if (!intersect_region(&crop_region, &zone_bounds)) {
+            log_debug("[Stream %s] Motion outside the detection zones in frame %d, skipping object detection",
+                     thread->stream_name, frame_count);
+            update_detection_interval(thread, time(NULL), false);
+            packet_pool_put_frame(thread->packet_pool, &sw_frame);
+            return 0;
+        }
+        crop_wanted = true;
+    }
+
+    // Over the memory budget object detection is skipped; recording goes on
+    if (!memory_budget_allows(MEMORY_TAG_DETECTION, 0)) {
+        log_debug("[Stream %s] Over the memory budget, skipping object detection on frame %d",
+                 thread->stream_name, frame_count);
+        update_detection_interval(thread, time(NULL), false);
+        packet_pool_put_frame(thread->packet_pool, &sw_frame);
+        return 0;
+    }
+
+    // CRITICAL FIX: Ensure only one detection is running at a time
+    // Lock the thread mutex to ensure exclusive access to the model
+    pthread_mutex_lock(&thread->mutex);
+
+    // Process the frame for detection using our dedicated model, loaded
+    // again here if it was evicted while the stream was idle
+    if (ensure_stream_model(thread)) {
+        // Convert frame to RGB format, or only the region the model looks at
+        int crop[4] = {0, 0, frame->width, frame->height};
+        const uint8_t *src_data[4] = {frame->data[0], frame->data[1], frame->data[2], frame->data[3]};
+        bool cropped = crop_wanted && crop_to_region(frame, &crop_region, crop, src_data);
+        int width = crop[2];
+        int height = crop[3];
+        int channels = 3; // RGB
+
+        // Determine if we should downscale the frame based on model type
+        const char *model_type = get_model_type_from_handle(thread->model);
+        int downscale_factor = get_downscale_factor(model_type);
+
+        // Calculate dimensions after downscaling
+        int target_width = width / downscale_factor;
+        int target_height = height / downscale_factor;
+
+        // Ensure dimensions are even (required by some codecs)
+        target_width = (target_width / 2) * 2;
+        target_height = (target_height / 2) * 2;
+
+        // SOD models resize YUV frames into their input themselves
+        yuv420_image_t yuv;
+        bool yuv_input = model_type && strcmp(model_type, MODEL_TYPE_SOD) == 0 &&
+                         frame_to_yuv420(frame, src_data, width, height, &yuv) &&
+                         sod_model_accepts_yuv420(thread->model);
+        uint8_t *rgb_buffer = NULL;
+
+        if (yuv_input) {
+            target_width = width;
+            target_height = height;
+        } else {
+            // The converter and its filter tables are only rebuilt when the
+            // frame geometry, crop or model input changes
+            thread->sws_ctx = sws_getCachedContext(thread->sws_ctx,
+                width, height, frame->format,
+                target_width, target_height, AV_PIX_FMT_RGB24,
+                SWS_BILINEAR, NULL, NULL, NULL);
+
+            if (!thread->sws_ctx) {
+                log_error("[Stream %s] Failed to create SwsContext", thread->stream_name);
+                pthread_mutex_unlock(&thread->mutex);
+                packet_pool_put_frame(thread->packet_pool, &sw_frame);
+                return -1;
+            }
+
+            // The RGB buffer only grows, so a stream keeps the one it needs
+            size_t rgb_size = (size_t)target_width * target_height * channels;
+            if (rgb_size > thread->rgb_buffer_size) {
+                uint8_t *grown = (uint8_t *)malloc(rgb_size);
+                if (!grown) {
+                    log_error("[Stream %s] Failed to allocate RGB buffer", thread->stream_name);
+                    pthread_mutex_unlock(&thread->mutex);
+                    packet_pool_put_frame(thread->packet_pool, &sw_frame);
+                    return -1;
+                }
+                if (thread->rgb_buffer) {
+                    memory_track(MEMORY_TAG_DETECTION, thread->rgb_buffer_size, false);
+                }
+                free(thread->rgb_buffer);
+                thread->rgb_buffer = grown;
+                thread->rgb_buffer_size = rgb_size;
+                memory_track(MEMORY_TAG_DETECTION, rgb_size, true);
+            }
+            rgb_buffer = thread->rgb_buffer;
+
+            // Setup RGB frame
+            uint8_t *rgb_data[4] = {rgb_buffer, NULL, NULL, NULL};
+            int rgb_linesize[4] = {target_width * channels, 0, 0, 0};
+
+            // Convert frame to RGB
+            sws_scale(thread->sws_ctx, src_data, frame->linesize, 0,
+                     height, rgb_data, rgb_linesize);
+        }
+
+        // Create detection result structure
+        detection_result_t result;
+        memset(&result, 0, sizeof(detection_result_t));
+
+        // Log before running detection
+        log_debug("[Stream %s] Running detection on frame %d (dimensions: %dx%d, %s, model: %s)",
+                thread->stream_name, frame_count, target_width, target_height,
+                yuv_input ? "YUV 4:2:0" : "RGB", model_type ? model_type : "unknown");
+
+        // Run detection on the RGB frame
+        int detect_ret;
+        uint64_t detect_started_us = metrics_now_us();
+
+        // Detections stored further down are attributed to the live frame
+        pipeline_trace_set_current(&thread->live_trace);
+
+        // Check if this is an API model
+        const char *api_model_type = get_model_type_from_handle(thread->model);
+        log_debug("[Stream %s] Model type: %s", thread->stream_name, api_model_type);
+
+        if (strcmp(api_model_type, MODEL_TYPE_API) == 0) {
+            // For API models, we need to pass the stream name
+            const char *model_path = get_model_path(thread->model);
+
+            // Get the API URL - either from the model path if it's a URL,
+            // or from the global config if it's the special "api-detection" string
+            const char *api_url = NULL;
+            if (model_path && ends_with(model_path, "api-detection")) {
+                // Get the API URL from the global config
+                api_url = g_config.api_detection_url;
+                log_debug("[Stream %s] Using API detection URL from config: %s",
+                        thread->stream_name, api_url ? api_url : "NULL");
+            } else {
+                // Use the model path directly as the URL
+                api_url = model_path;
+                log_debug("[Stream %s] Using API detection with URL from model path: %s",
+                        thread->stream_name, api_url ? api_url : "NULL");
+            }
+
+            if (!api_url || api_url[0] == '\0') {
+                log_error("[Stream %s] Failed to get API URL from model or config", thread->stream_name);
+                detect_ret = -1;
+                // Initialize result to empty to prevent segmentation fault
+                memset(&result, 0, sizeof(detection_result_t));
+            } else {
+                log_debug("[Stream %s] Calling detect_objects_api with URL: %s", thread->stream_name, api_url);
+                // CRITICAL FIX: Initialize result to empty before calling API detection
+                memset(&result, 0, sizeof(detection_result_t));
+                detect_ret = detect_objects_api(api_url, rgb_buffer, target_width, target_height, channels, &result, thread->stream_name);
+                log_debug("[Stream %s] detect_objects_api returned: %d", thread->stream_name, detect_ret);
+            }
+        } else {
+            // CRITICAL FIX: Initialize result to empty before calling detection
+            memset(&result, 0, sizeof(detection_result_t));
+            if (yuv_input) {
+                detect_ret = detect_with_sod_model_yuv420(thread->model, &yuv, &result);
+                log_debug("[Stream %s] detect_with_sod_model_yuv420 returned: %d", thread->stream_name, detect_ret);
+            } else {
+                // For other models, use the standard detect_objects function
+                log_debug("[Stream %s] Using standard detect_objects function", thread->stream_name);
+                detect_ret = detect_objects(thread->model, rgb_buffer, target_width, target_height, channels, &result);
+                log_debug("[Stream %s] detect_objects returned: %d", thread->stream_name, detect_ret);
+            }
+        }
+
+        metrics_observe_since(thread->latency_metric, detect_started_us);
+        pipeline_trace_stage(thread->inference_metric, &thread->live_trace);
+
+        if (detect_ret == 0) {
+            // Boxes found in the crop are mapped back to the whole frame
+            if (cropped) {
+                float crop_x = (float)crop[0] / frame->width;
+                float crop_y = (float)crop[1] / frame->height;
+                float crop_w = (float)crop[2] / frame->width;
+                float crop_h = (float)crop[3] / frame->height;
+                for (int i = 0; i < result.count && i < MAX_DETECTIONS; i++) {
+                    result.detections[i].x = crop_x + result.detections[i].x * crop_w;
+                    result.detections[i].y = crop_y + result.detections[i].y * crop_h;
+                    result.detections[i].width *= crop_w;
+                    result.detections[i].height *= crop_h;
+                }
+            }
+
+            // Objects seen around a zone but not standing in it are not stored
+            int outside = filter_detections_by_zones(thread->zones, thread->zone_count, &result);
+            if (outside > 0) {
+                log_debug("[Stream %s] Dropped %d detections outside the detection zones",
+                         thread->stream_name, outside);
+            }
+
+            // Recording, the database and live overlays take the results from here
+            publish_detections(thread, &result, frame_timestamp,
+                               decoded->pts != AV_NOPTS_VALUE ? decoded->pts : -1);
+
+            // Process detection results
+            if (result.count > 0) {
+                log_debug("[Stream %s] Detection found %d objects in frame %d",
+                        thread->stream_name, result.count, frame_count);
+
+                // Log each detected object
+                for (int i = 0; i < result.count && i < MAX_DETECTIONS; i++) {
+                    log_debug("[Stream %s] Object %d: class=%s, confidence=%.2f, box=[%.2f,%.2f,%.2f,%.2f]",
+                            thread->stream_name, i, result.detections[i].label,
+                            result.detections[i].confidence,
+                            result.detections[i].x, result.detections[i].y,
+                            result.detections[i].width, result.detections[i].height);
+                }
+            } else {
+                log_debug("[Stream %s] No objects detected in frame %d", thread->stream_name, frame_count);
+            }
+        } else {
+            log_error_ratelimited("[Stream %s] Detection failed for frame %d (error code: %d)",
+                     thread->stream_name, frame_count, detect_ret);
+            // Continue execution despite detection failure
+            log_debug("[Stream %s] Continuing detection thread despite detection failure", thread->stream_name);
+            // Set result.count to 0 to indicate no detections
+            result.count = 0;
+        }
+
+        pipeline_trace_set_current(NULL);
+
+        // Motion that opened the gate keeps the stream at full rate even when the model found nothing
+        update_detection_interval(thread, time(NULL), result.count > 0 || thread->motion_gate != MOTION_GATE_OFF);
+
+        // Update last detection time
+        thread->last_detection_time = time(NULL);
+    }
+
+    // CRITICAL FIX: Release the mutex after detection is complete
+    pthread_mutex_unlock(&thread->mutex);
+
+    packet_pool_put_frame(thread->packet_pool, &sw_frame);
+    return 0;
+}
+
+static void segment_detection_job(void *ctx, const AVFrame *frame, int frame_count, time_t timestamp) {
+    if (frame) {
+        detect_decoded_frame((stream_detection_thread_t *)ctx, frame, frame_count, timestamp);
+    }
+}
+
+/**
+ * Run detection on a frame decoded from a segment on the detection workers
+ * Waits for the result, since the frame is reused for the next packet and
+ * segments are processed in order; without a running scheduler the
+ * detection runs inline.
+ */
+static void detect_segment_frame(stream_detection_thread_t *thread, const AVFrame *frame,
+                                 int frame_count, time_t frame_timestamp) {
+    // Frames read back from segments are not traced
+    memset(&thread->live_trace, 0, sizeof(thread->live_trace));
+    if (detection_scheduler_run(thread->stream_id, segment_detection_job, thread,
+                                frame, frame_count, frame_timestamp) != 0) {
+        detect_decoded_frame(thread, frame, frame_count, frame_timestamp);
+    }
+}
+
+
+/**
+ * Get the decoder discard level matching a sampling mode
+ */
+static enum AVDiscard detection_skip_frame(int frame_step) {
+    return frame_step > 0 ? AVDISCARD_NONREF : AVDISCARD_NONKEY;
+}
+
+/**
+ * Have the decoder export motion vectors for the motion gate ([models] motion_vectors)
+ * Only the software H.264 decoder exports them, and only predicted frames
+ * carry them, so this needs a motion gate and a sampling mode that decodes
+ * more than key frames. The loop filter is skipped too: the gate reads no
+ * pixels, and the model tolerates the block edges it would smooth.
+ *
+ * @param thread Detection thread
+ * @param codec_ctx Decoder context, not yet opened
+ * @param frame_step Sampling mode the decoder is opened for
+ * @return true if vectors are exported; hardware decoding must stay off then
+ */
+static bool setup_motion_vectors(stream_detection_thread_t *thread, AVCodecContext *codec_ctx, int frame_step) {
+    thread->motion_vectors = g_config.motion_vectors && thread->motion_gate != MOTION_GATE_OFF &&
+                             frame_step > 0 && codec_ctx->codec_id == AV_CODEC_ID_H264;
+    if (thread->motion_vectors) {
+        codec_ctx->flags2 |= AV_CODEC_FLAG2_EXPORT_MVS;
+        codec_ctx->skip_loop_filter = AVDISCARD_ALL;
+    }
+    return thread->motion_vectors;
+}
+
+/**
+ * Decode a single key frame packet
+ * The decoder is drained and flushed afterwards so the picture comes out
+ * immediately instead of after the next GOP.
+ *
+ * @param codec_ctx Decoder context
+ * @param pkt Key frame packet
+ * @param frame Frame receiving the picture
+ * @return 0 if a picture was decoded, -1 otherwise
+ */
+static int decode_key_frame(AVCodecContext *codec_ctx, const AVPacket *pkt, AVFrame *frame) {
+    int result = -1;
+
+    if (avcodec_send_packet(codec_ctx, pkt) == 0) {
+        avcodec_send_packet(codec_ctx, NULL);
+        if (avcodec_receive_frame(codec_ctx, frame) == 0) {
+            result = 0;
+        }
+    }
+
+    avcodec_flush_buffers(codec_ctx);
+    return result;
+}
 
 /**
  * Process an HLS segment file for detection
@@ -209,14 +851,13 @@ int process_segment_for_detection(stream_detection_thread_t *thread, const char
     AVCodecContext *codec_ctx = NULL;
     AVFrame *frame = NULL;
     AVPacket *pkt = NULL;
-    struct SwsContext *sws_ctx = NULL;
     int video_stream_idx = -1;
     int ret = -1;
 
     // CRITICAL FIX: Use a try/catch block to handle potential segfaults
     __attribute__((unused)) volatile int segment_check_result = 0;
 
-    log_info("[Stream %s] Processing HLS segment for detection: %s",
+    log_debug("[Stream %s] Processing HLS segment for detection: %s",
              thread->stream_name, segment_path);
 
     // CRITICAL FIX: Double-check that the segment still exists and is valid before trying to open it
@@ -242,8 +883,20 @@ int process_segment_for_detection(stream_detection_thread_t *thread, const char
     // This prevents potential double-free issues if avformat_open_input fails
     format_ctx = NULL;
 
+    // fMP4 segments hold no codec parameters of their own; read them after the
+    // init segment the writer keeps next to them
+    char input_url[MAX_PATH_LENGTH * 2 + 16];
+    const char *ext = strrchr(segment_path, '.');
+    const char *slash = strrchr(segment_path, '/');
+    if (ext && strcmp(ext, ".m4s") == 0 && slash) {
+        snprintf(input_url, sizeof(input_url), "concat:%.*s/init.mp4|%s",
+                 (int)(slash - segment_path), segment_path, segment_path);
+    } else {
+        snprintf(input_url, sizeof(input_url), "%s", segment_path);
+    }
+
     // Open input file with safety checks
-    int open_result = avformat_open_input(&format_ctx, segment_path, NULL, NULL);
+    int open_result = avformat_open_input(&format_ctx, input_url, NULL, NULL);
     if (open_result != 0) {
         char err_buf[AV_ERROR_MAX_STRING_SIZE] = {0};
         av_strerror(open_result, err_buf, sizeof(err_buf));
@@ -320,7 +973,7 @@ int process_segment_for_detection(stream_detection_thread_t *thread, const char
         return 0;
     }
 
-    const AVCodec *codec = avcodec_find_decoder(format_ctx->streams[video_stream_idx]->codecpar->codec_id);
+    const AVCodec *codec = hw_decode_find_decoder(format_ctx->streams[video_stream_idx]->codecpar->codec_id);
     if (!codec) {
         log_error("[Stream %s] Unsupported codec in segment file: %s (codec_id: %d)",
                  thread->stream_name, segment_path, format_ctx->streams[video_stream_idx]->codecpar->codec_id);
@@ -355,6 +1008,15 @@ int process_segment_for_detection(stream_detection_thread_t *thread, const char
         return 0;
     }
 
+    // The sampling mode holds for the whole segment, even if the load governor changes it meanwhile
+    int frame_step = detection_frame_step(thread);
+
+    // Let the decoder skip the pictures the sampling mode will never look at
+    codec_ctx->skip_frame = detection_skip_frame(frame_step);
+    if (!setup_motion_vectors(thread, codec_ctx, frame_step)) {
+        hw_decode_setup(codec_ctx);
+    }
+
     // Open codec with safety checks
     int open_codec_result = avcodec_open2(codec_ctx, codec, NULL);
     if (open_codec_result < 0) {
@@ -369,7 +1031,7 @@ int process_segment_for_detection(stream_detection_thread_t *thread, const char
     }
 
     // Allocate frame and packet with safety checks
-    frame = av_frame_alloc();
+    frame = packet_pool_get_frame(thread->packet_pool);
     if (!frame) {
         log_error("[Stream %s] Could not allocate frame for segment file: %s",
                  thread->stream_name, segment_path);
@@ -382,11 +1044,11 @@ int process_segment_for_detection(stream_detection_thread_t *thread, const char
 
     // Frame is now allocated
 
-    pkt = av_packet_alloc();
+    pkt = packet_pool_get_packet(thread->packet_pool);
     if (!pkt) {
         log_error("[Stream %s] Could not allocate packet for segment file: %s",
                  thread->stream_name, segment_path);
-        av_frame_free(&frame);
+        packet_pool_put_frame(thread->packet_pool, &frame);
         avcodec_free_context(&codec_ctx);
         safe_avformat_cleanup(&format_ctx); // Use our safe cleanup function
         log_info("[Stream %s] Continuing detection thread despite failure to allocate packet", thread->stream_name);
@@ -398,6 +1060,7 @@ int process_segment_for_detection(stream_detection_thread_t *thread, const char
 
     // Initialize frame_count at the beginning of the function
     int frame_count = 0;
+    int last_sampled_frame = 0;
 
     // Calculate segment duration with safety checks
     float segment_duration = 0;
@@ -423,7 +1086,7 @@ int process_segment_for_detection(stream_detection_thread_t *thread, const char
     AVRational frame_rate = av_guess_frame_rate(format_ctx, format_ctx->streams[video_stream_idx], NULL);
     if (frame_rate.num > 0 && frame_rate.den > 0) {
         frames_per_second = (double)frame_rate.num / frame_rate.den;
-        log_info("[Stream %s] Using stream frame rate: %.2f fps",
+        log_debug("[Stream %s] Using stream frame rate: %.2f fps",
                  thread->stream_name, frames_per_second);
     } else {
         // Use a reasonable default if we can't get the frame rate
@@ -449,7 +1112,7 @@ int process_segment_for_detection(stream_detection_thread_t *thread, const char
         total_frames = 50; // Use a reasonable default
     }
 
-    log_info("[Stream %s] Segment duration: %.2f seconds, FPS: %.2f, Estimated total frames: %d",
+    log_debug("[Stream %s] Segment duration: %.2f seconds, FPS: %.2f, Estimated total frames: %d",
              thread->stream_name, segment_duration, frames_per_second, total_frames);
 
     // Read frames with safety checks
@@ -466,7 +1129,7 @@ int process_segment_for_detection(stream_detection_thread_t *thread, const char
         if (read_result < 0) {
             // Check if we've reached the end of the file
             if (read_result == AVERROR_EOF) {
-                log_info("[Stream %s] Reached end of segment file: %s",
+                log_debug("[Stream %s] Reached end of segment file: %s",
                         thread->stream_name, segment_path);
                 break;
             }
@@ -474,7 +1137,7 @@ int process_segment_for_detection(stream_detection_thread_t *thread, const char
             // Log other errors
             char err_buf[AV_ERROR_MAX_STRING_SIZE] = {0};
             av_strerror(read_result, err_buf, sizeof(err_buf));
-            log_error("[Stream %s] Error reading frame from segment file: %s (error: %s)",
+            log_error_ratelimited("[Stream %s] Error reading frame from segment file: %s (error: %s)",
                      thread->stream_name, segment_path, err_buf);
 
             // Count errors and break if too many
@@ -494,12 +1157,25 @@ int process_segment_for_detection(stream_detection_thread_t *thread, const char
         if (pkt->stream_index == video_stream_idx) {
             frame_count++;
 
+            // In key frame mode, there is no point in handing anything else to the decoder
+            if (frame_step <= 0) {
+                if ((pkt->flags & AV_PKT_FLAG_KEY) && decode_key_frame(codec_ctx, pkt, frame) == 0) {
+                    log_debug("[Stream %s] Processing key frame %d from segment file: %s",
+                            thread->stream_name, frame_count, segment_path);
+                    detect_segment_frame(thread, frame, frame_count, time(NULL));
+                    av_frame_unref(frame);
+                    processed_frames++;
+                }
+                av_packet_unref(pkt);
+                continue;
+            }
+
             // Send packet to decoder with safety checks
             ret = avcodec_send_packet(codec_ctx, pkt);
             if (ret < 0) {
                 char err_buf[AV_ERROR_MAX_STRING_SIZE] = {0};
                 av_strerror(ret, err_buf, sizeof(err_buf));
-                log_error("[Stream %s] Error sending packet to decoder for segment file: %s (error: %s)",
+                log_error_ratelimited("[Stream %s] Error sending packet to decoder for segment file: %s (error: %s)",
                          thread->stream_name, segment_path, err_buf);
                 av_packet_unref(pkt);
                 continue;
@@ -513,7 +1189,7 @@ int process_segment_for_detection(stream_detection_thread_t *thread, const char
             } else if (ret < 0) {
                 char err_buf[AV_ERROR_MAX_STRING_SIZE] = {0};
                 av_strerror(ret, err_buf, sizeof(err_buf));
-                log_error("[Stream %s] Error receiving frame from decoder for segment file: %s (error: %s)",
+                log_error_ratelimited("[Stream %s] Error receiving frame from decoder for segment file: %s (error: %s)",
                          thread->stream_name, segment_path, err_buf);
 
                 // Count errors and break if too many
@@ -530,178 +1206,23 @@ int process_segment_for_detection(stream_detection_thread_t *thread, const char
                 continue;
             }
 
-            // OPTIMIZATION: Process only key frames (I-frames) to reduce CPU usage
-            // Check if this is a key frame (I-frame)
-            bool is_key_frame = frame->key_frame || (frame->pict_type == AV_PICTURE_TYPE_I);
+            // Every Nth frame mode: sample the first picture at least frame_step frames
+            // after the previous sample
+            bool sample_due = last_sampled_frame == 0 || frame_count - last_sampled_frame >= frame_step;
 
-            if (is_key_frame) {
-                log_info("[Stream %s] Processing key frame %d (pict_type: %d, key_frame: %d)",
+            if (sample_due) {
+                last_sampled_frame = frame_count;
+                log_debug("[Stream %s] Processing sampled frame %d (pict_type: %d, key_frame: %d)",
                         thread->stream_name, frame_count, frame->pict_type, frame->key_frame);
 
                 // Process the frame for detection
-                log_info("[Stream %s] Processing frame %d from segment file: %s",
+                log_debug("[Stream %s] Processing frame %d from segment file: %s",
                         thread->stream_name, frame_count, segment_path);
 
                 // Calculate frame timestamp based on segment timestamp
                 time_t frame_timestamp = time(NULL);
 
-                // CRITICAL FIX: Ensure only one detection is running at a time
-                // Lock the thread mutex to ensure exclusive access to the model
-                pthread_mutex_lock(&thread->mutex);
-
-                // Process the frame for detection using our dedicated model
-                if (thread->model) {
-                    // Convert frame to RGB format
-                    int width = frame->width;
-                    int height = frame->height;
-                    int channels = 3; // RGB
-
-                    // Determine if we should downscale the frame based on model type
-                    const char *model_type = get_model_type_from_handle(thread->model);
-                    int downscale_factor = get_downscale_factor(model_type);
-
-                    // Calculate dimensions after downscaling
-                    int target_width = width / downscale_factor;
-                    int target_height = height / downscale_factor;
-
-                    // Ensure dimensions are even (required by some codecs)
-                    target_width = (target_width / 2) * 2;
-                    target_height = (target_height / 2) * 2;
-
-                    // Convert frame to RGB format with downscaling
-                    sws_ctx = sws_getContext(
-                        width, height, frame->format,
-                        target_width, target_height, AV_PIX_FMT_RGB24,
-                        SWS_BILINEAR, NULL, NULL, NULL);
-
-                    if (!sws_ctx) {
-                        log_error("[Stream %s] Failed to create SwsContext", thread->stream_name);
-                        av_packet_unref(pkt);
-                        continue;
-                    }
-
-                    // SwsContext is now allocated
-
-                    // Allocate buffer for RGB frame
-                    uint8_t *rgb_buffer = (uint8_t *)malloc(target_width * target_height * channels);
-                    if (!rgb_buffer) {
-                        log_error("[Stream %s] Failed to allocate RGB buffer", thread->stream_name);
-                        sws_freeContext(sws_ctx);
-                        av_packet_unref(pkt);
-                        continue;
-                    }
-
-                    // Setup RGB frame
-                    uint8_t *rgb_data[4] = {rgb_buffer, NULL, NULL, NULL};
-                    int rgb_linesize[4] = {target_width * channels, 0, 0, 0};
-
-                    // Convert frame to RGB
-                    sws_scale(sws_ctx, (const uint8_t * const *)frame->data, frame->linesize, 0,
-                             height, rgb_data, rgb_linesize);
-
-                    // Create detection result structure
-                    detection_result_t result;
-                    memset(&result, 0, sizeof(detection_result_t));
-
-                    // Log before running detection
-                    log_info("[Stream %s] Running detection on frame %d (dimensions: %dx%d, channels: %d, model: %s)",
-                            thread->stream_name, frame_count, target_width, target_height, channels,
-                            model_type ? model_type : "unknown");
-
-                    // Run detection on the RGB frame
-                    int detect_ret;
-
-                    // Check if this is an API model
-                    const char *api_model_type = get_model_type_from_handle(thread->model);
-                    log_info("[Stream %s] Model type: %s", thread->stream_name, api_model_type);
-
-                    if (strcmp(api_model_type, MODEL_TYPE_API) == 0) {
-                        // For API models, we need to pass the stream name
-                        const char *model_path = get_model_path(thread->model);
-
-                        // Get the API URL - either from the model path if it's a URL,
-                        // or from the global config if it's the special "api-detection" string
-                        const char *api_url = NULL;
-                        if (model_path && ends_with(model_path, "api-detection")) {
-                            // Get the API URL from the global config
-                            api_url = g_config.api_detection_url;
-                            log_info("[Stream %s] Using API detection URL from config: %s",
-                                    thread->stream_name, api_url ? api_url : "NULL");
-                        } else {
-                            // Use the model path directly as the URL
-                            api_url = model_path;
-                            log_info("[Stream %s] Using API detection with URL from model path: %s",
-                                    thread->stream_name, api_url ? api_url : "NULL");
-                        }
-
-                        if (!api_url || api_url[0] == '\0') {
-                            log_error("[Stream %s] Failed to get API URL from model or config", thread->stream_name);
-                            detect_ret = -1;
-                            // Initialize result to empty to prevent segmentation fault
-                            memset(&result, 0, sizeof(detection_result_t));
-                        } else {
-                            log_info("[Stream %s] Calling detect_objects_api with URL: %s", thread->stream_name, api_url);
-                            // CRITICAL FIX: Initialize result to empty before calling API detection
-                            memset(&result, 0, sizeof(detection_result_t));
-                            detect_ret = detect_objects_api(api_url, rgb_buffer, target_width, target_height, channels, &result, thread->stream_name);
-                            log_info("[Stream %s] detect_objects_api returned: %d", thread->stream_name, detect_ret);
-                        }
-                    } else {
-                        // For other models, use the standard detect_objects function
-                        log_info("[Stream %s] Using standard detect_objects function", thread->stream_name);
-                        // CRITICAL FIX: Initialize result to empty before calling detection
-                        memset(&result, 0, sizeof(detection_result_t));
-                        detect_ret = detect_objects(thread->model, rgb_buffer, target_width, target_height, channels, &result);
-                        log_info("[Stream %s] detect_objects returned: %d", thread->stream_name, detect_ret);
-                    }
-
-                    if (detect_ret == 0) {
-                        // Process detection results
-                        if (result.count > 0) {
-                            log_info("[Stream %s] Detection found %d objects in frame %d",
-                                    thread->stream_name, result.count, frame_count);
-
-                            // Log each detected object
-                            for (int i = 0; i < result.count && i < MAX_DETECTIONS; i++) {
-                                log_info("[Stream %s] Object %d: class=%s, confidence=%.2f, box=[%.2f,%.2f,%.2f,%.2f]",
-                                        thread->stream_name, i, result.detections[i].label,
-                                        result.detections[i].confidence,
-                                        result.detections[i].x, result.detections[i].y,
-                                        result.detections[i].width, result.detections[i].height);
-                            }
-
-                            // Process the detection results for recording
-                            int record_ret = process_frame_for_recording(thread->stream_name, rgb_buffer, target_width,
-                                                                       target_height, channels, frame_timestamp, &result);
-
-                            if (record_ret != 0) {
-                                log_error("[Stream %s] Failed to process frame for recording (error code: %d)",
-                                         thread->stream_name, record_ret);
-                            } else {
-                                log_info("[Stream %s] Successfully processed frame for recording", thread->stream_name);
-                            }
-                        } else {
-                            log_debug("[Stream %s] No objects detected in frame %d", thread->stream_name, frame_count);
-                        }
-                    } else {
-                        log_error("[Stream %s] Detection failed for frame %d (error code: %d)",
-                                 thread->stream_name, frame_count, detect_ret);
-                        // Continue execution despite detection failure
-                        log_info("[Stream %s] Continuing detection thread despite detection failure", thread->stream_name);
-                        // Set result.count to 0 to indicate no detections
-                        result.count = 0;
-                    }
-
-                    // Free resources
-                    free(rgb_buffer);
-                    sws_freeContext(sws_ctx);
-
-                    // Update last detection time
-                    thread->last_detection_time = time(NULL);
-                }
-
-                // CRITICAL FIX: Release the mutex after detection is complete
-                pthread_mutex_unlock(&thread->mutex);
+                detect_segment_frame(thread, frame, frame_count, frame_timestamp);
 
                 processed_frames++;
             }
@@ -710,7 +1231,7 @@ int process_segment_for_detection(stream_detection_thread_t *thread, const char
         av_packet_unref(pkt);
     }
 
-    log_info("[Stream %s] Processed %d frames out of %d total frames from segment file: %s (errors: %d)",
+    log_debug("[Stream %s] Processed %d frames out of %d total frames from segment file: %s (errors: %d)",
              thread->stream_name, processed_frames, frame_count, segment_path, error_frames);
 
     // CRITICAL FIX: Use comprehensive cleanup to prevent memory leaks and segmentation faults
@@ -719,12 +1240,12 @@ int process_segment_for_detection(stream_detection_thread_t *thread, const char
     // Cleanup with safety checks
     if (frame) {
         log_debug("[Stream %s] Freeing frame during cleanup", thread->stream_name);
-        av_frame_free(&frame);
+        packet_pool_put_frame(thread->packet_pool, &frame);
     }
 
     if (pkt) {
         log_debug("[Stream %s] Freeing packet during cleanup", thread->stream_name);
-        av_packet_free(&pkt);
+        packet_pool_put_packet(thread->packet_pool, &pkt);
     }
 
     if (codec_ctx) {
@@ -789,26 +1310,358 @@ static void check_for_new_segments(stream_detection_thread_t *thread) {
         // If no segments were found, attempt to restart the HLS stream if needed
         restart_hls_stream_if_needed(thread, current_time, &last_warning_time, first_check);
 
-        // We would do go2rtc fallback here in the original function, but we're keeping that in the original file
-        // as it's very complex and would make our helper implementation too large
+        // We would do go2rtc fallback here in the original function, but we're keeping that in the original file
+        // as it's very complex and would make our helper implementation too large
+
+        consecutive_failures++;
+        first_check = false;
+        return;
+    }
+
+    // Reset failure counter when we find segments
+    consecutive_failures = 0;
+
+    log_info("[Stream %s] Found %d segments, newest segment time: %s",
+             thread->stream_name, segment_count, ctime(&newest_time));
+
+    // Process the segment if needed
+    static char last_processed_segment[MAX_PATH_LENGTH] = {0};
+    process_segment_if_needed(thread, newest_segment, last_processed_segment,
+                             should_run_detection, newest_time, current_time);
+
+    first_check = false;
+}
+
+/**
+ * Resolve the URL the shared ingest serves for a stream
+ * A configured detection sub-stream is used as-is, so detection decodes the
+ * camera's low-resolution stream while recording keeps the main one. Otherwise,
+ * when HLS goes through go2rtc, its RTSP output is used so that detection
+ * shares the HLS writer's connection instead of opening another one.
+ *
+ * @param stream_name Name of the stream
+ * @param url Buffer receiving the URL
+ * @param url_size Size of the buffer
+ * @param protocol Receives the stream protocol
+ * @return 0 on success, -1 on failure
+ */
+static int get_live_detection_url(const char *stream_name, char *url, size_t url_size, int *protocol) {
+    stream_config_t config;
+    if (get_stream_config_by_name(stream_name, &config) != 0 || config.url[0] == '\0') {
+        return -1;
+    }
+
+    *protocol = config.protocol;
+
+    if (config.detection_url[0] != '\0') {
+        strncpy(url, config.detection_url, url_size - 1);
+        url[url_size - 1] = '\0';
+        log_info("[Stream %s] Using detection sub-stream %s", stream_name, url);
+        return 0;
+    }
+
+    strncpy(url, config.url, url_size - 1);
+    url[url_size - 1] = '\0';
+
+    if (go2rtc_integration_is_using_go2rtc_for_hls(stream_name) &&
+        !go2rtc_get_rtsp_url(stream_name, url, url_size)) {
+        log_warn("[Stream %s] Failed to get go2rtc RTSP URL for detection, using camera URL", stream_name);
+        strncpy(url, config.url, url_size - 1);
+        url[url_size - 1] = '\0';
+    }
+
+    return 0;
+}
+
+/**
+ * Open a decoder for the video stream of a live detection consumer
+ * The decoder discards the pictures the thread's sampling mode never looks at.
+ *
+ * @param thread Detection thread
+ * @param consumer Ingest consumer
+ * @param video_stream_idx Receives the video stream index
+ * @return Decoder context or NULL on failure
+ */
+static AVCodecContext *open_live_decoder(stream_detection_thread_t *thread,
+                                         stream_ingest_consumer_t *consumer, int *video_stream_idx) {
+    AVFormatContext *fmt_ctx = stream_ingest_get_format_context(consumer);
+    int idx = stream_ingest_get_video_stream_index(consumer);
+    if (!fmt_ctx || idx < 0 || idx >= (int)fmt_ctx->nb_streams) {
+        log_error("[Stream %s] No video stream available for live detection", thread->stream_name);
+        return NULL;
+    }
+
+    const AVCodecParameters *codecpar = fmt_ctx->streams[idx]->codecpar;
+    const AVCodec *codec = hw_decode_find_decoder(codecpar->codec_id);
+    if (!codec) {
+        log_error("[Stream %s] No decoder for codec %s", thread->stream_name,
+                 avcodec_get_name(codecpar->codec_id));
+        return NULL;
+    }
+
+    AVCodecContext *codec_ctx = avcodec_alloc_context3(codec);
+    if (!codec_ctx) {
+        log_error("[Stream %s] Failed to allocate decoder context", thread->stream_name);
+        return NULL;
+    }
+
+    if (avcodec_parameters_to_context(codec_ctx, codecpar) < 0) {
+        log_error("[Stream %s] Failed to copy codec parameters", thread->stream_name);
+        avcodec_free_context(&codec_ctx);
+        return NULL;
+    }
+
+    int frame_step = detection_frame_step(thread);
+    codec_ctx->skip_frame = detection_skip_frame(frame_step);
+    codec_ctx->thread_count = 1;
+    bool hw_decoding = !setup_motion_vectors(thread, codec_ctx, frame_step) && hw_decode_setup(codec_ctx) == 0;
+
+    int ret = avcodec_open2(codec_ctx, codec, NULL);
+    if (ret < 0) {
+        char err_buf[AV_ERROR_MAX_STRING_SIZE] = {0};
+        av_strerror(ret, err_buf, sizeof(err_buf));
+        log_error("[Stream %s] Failed to open decoder: %s", thread->stream_name, err_buf);
+        avcodec_free_context(&codec_ctx);
+        return NULL;
+    }
+
+    log_info("[Stream %s] Live detection decoder %s opened (%s%s)", thread->stream_name, codec->name,
+            hw_decoding ? hw_decode_backend_name() : "software",
+            thread->motion_vectors ? ", motion vectors" : "");
+
+    *video_stream_idx = idx;
+    return codec_ctx;
+}
+
+/**
+ * Check whether the next key frame should be run through detection
+ * Same rules as the segment path, without the per-check logging.
+ */
+static bool live_detection_due(stream_detection_thread_t *thread, time_t now) {
+    if (global_startup_delay_end > 0 && now < global_startup_delay_end) {
+        return false;
+    }
+
+    if (atomic_load(&thread->detection_in_progress)) {
+        return false;
+    }
+
+    if (detection_paused_by_load(thread, now)) {
+        return false;
+    }
+
+    return detection_interval_elapsed(thread, now);
+}
+
+/**
+ * Scheduler job for a live frame; clears the in-progress flag even when the
+ * frame was dropped for a newer one
+ */
+static void live_detection_job(void *ctx, const AVFrame *frame, int frame_count, time_t timestamp) {
+    stream_detection_thread_t *thread = (stream_detection_thread_t *)ctx;
+    if (frame) {
+        detect_decoded_frame(thread, frame, frame_count, timestamp);
+    }
+    atomic_store(&thread->detection_in_progress, 0);
+}
+
+/**
+ * Hand one live frame to the detection workers, marking the detection as in
+ * progress until a worker has run it
+ * The stream thread goes back to reading packets right away; without a
+ * running scheduler the detection runs inline.
+ */
+static void detect_live_frame(stream_detection_thread_t *thread, const AVFrame *frame, int frame_count,
+                              const pipeline_trace_t *trace) {
+    // Only one live detection is in flight, so the trace can wait in the thread
+    thread->live_trace = *trace;
+    atomic_store(&thread->detection_in_progress, 1);
+    if (detection_scheduler_submit(thread->stream_id, live_detection_job, thread,
+                                   frame, frame_count, time(NULL)) != 0) {
+        live_detection_job(thread, frame, frame_count, time(NULL));
+    }
+}
+
+/**
+ * Run detection on frames decoded from the live stream
+ * Attaches a "detection" consumer to the stream's shared ingest. In key frame
+ * mode only the first key frame after each detection interval is decoded; in
+ * every Nth frame mode the decoder is fed continuously (skipping non-reference
+ * pictures) and every Nth frame is sampled once the interval has elapsed.
+ * Either way detections no longer wait for an HLS segment to be written and
+ * re-opened from disk. With packet_activity_gate, a stream whose packet
+ * sizes show no activity is not decoded beyond a key frame every
+ * detection_interval_max seconds.
+ *
+ * @param thread Detection thread
+ * @return 0 once the thread has been stopped, -1 if the ingest is not available
+ */
+static int run_live_detection(stream_detection_thread_t *thread) {
+    char url[MAX_URL_LENGTH];
+    int protocol = STREAM_PROTOCOL_TCP;
+    if (get_live_detection_url(thread->stream_name, url, sizeof(url), &protocol) != 0) {
+        log_warn("[Stream %s] No stream URL for live detection, falling back to HLS segments",
+                thread->stream_name);
+        return -1;
+    }
+
+    stream_ingest_consumer_t *consumer = stream_ingest_attach(thread->stream_name, url, protocol,
+                                                              "detection", LIVE_DETECTION_QUEUE_DEPTH, true);
+    if (!consumer) {
+        log_warn("[Stream %s] Failed to attach to shared ingest, falling back to HLS segments",
+                thread->stream_name);
+        return -1;
+    }
+
+    AVPacket *pkt = packet_pool_get_packet(thread->packet_pool);
+    AVFrame *frame = packet_pool_get_frame(thread->packet_pool);
+    if (!pkt || !frame) {
+        log_error("[Stream %s] Failed to allocate packet or frame for live detection", thread->stream_name);
+        packet_pool_put_packet(thread->packet_pool, &pkt);
+        packet_pool_put_frame(thread->packet_pool, &frame);
+        stream_ingest_detach(consumer);
+        return -1;
+    }
+
+    log_info("[Stream %s] Running detection on live frames from shared ingest", thread->stream_name);
+
+    AVCodecContext *codec_ctx = NULL;
+    int video_stream_idx = -1;
+    int frame_count = 0;
+    int frames_since_sample = 0;
+    int frame_step = 0;
+    bool decoder_synced = false;
+    bool quiet = false;
+    time_t last_quiet_check = 0;
+
+    while (thread->running && !is_shutdown_initiated()) {
+        if (!codec_ctx) {
+            int ret = stream_ingest_wait_for_streams(consumer, 1000);
+            if (ret == AVERROR_EOF) {
+                break;
+            }
+            if (ret != 0) {
+                continue;
+            }
+
+            codec_ctx = open_live_decoder(thread, consumer, &video_stream_idx);
+            if (!codec_ctx) {
+                usleep(1000000);
+                continue;
+            }
+            frame_step = detection_frame_step(thread);
+            decoder_synced = false;
+        }
+
+        int ret = stream_ingest_read_packet(consumer, pkt, 500);
+        if (ret == AVERROR(EAGAIN)) {
+            continue;
+        }
+        if (ret == STREAM_INGEST_STREAMS_CHANGED) {
+            log_info("[Stream %s] Input streams changed, reopening detection decoder", thread->stream_name);
+            avcodec_free_context(&codec_ctx);
+            continue;
+        }
+        if (ret < 0) {
+            break;
+        }
+
+        if (pkt->stream_index != video_stream_idx) {
+            av_packet_unref(pkt);
+            continue;
+        }
+
+        // The load governor can switch the stream to key frames only and back
+        int step = detection_frame_step(thread);
+        if (step != frame_step) {
+            log_info("[Stream %s] Detection now decodes %s", thread->stream_name,
+                    step > 0 ? "every Nth frame" : "key frames only");
+            codec_ctx->skip_frame = detection_skip_frame(step);
+            frame_step = step;
+            decoder_synced = false;
+        }
+
+        // A quiet stream is left undecoded, so decoding every Nth frame
+        // resumes from the first key frame after activity
+        bool was_quiet = quiet;
+        quiet = g_config.packet_activity_gate && !stream_ingest_active(consumer, PACKET_ACTIVITY_HOLD_MS);
+        if (quiet != was_quiet) {
+            log_debug("[Stream %s] Packet sizes show %s", thread->stream_name, quiet ? "no activity" : "activity");
+            avcodec_flush_buffers(codec_ctx);
+            decoder_synced = false;
+        }
+
+        if (frame_step > 0 && !quiet) {
+            // Every Nth frame: the decoder needs every reference frame from
+            // the first key frame on
+            if (!decoder_synced && !(pkt->flags & AV_PKT_FLAG_KEY)) {
+                av_packet_unref(pkt);
+                continue;
+            }
+            decoder_synced = true;
+            frames_since_sample++;
+
+            // Frames are attributed to the last packet sent, which is exact
+            // for streams without B-frames
+            if (avcodec_send_packet(codec_ctx, pkt) == 0) {
+                while (avcodec_receive_frame(codec_ctx, frame) == 0) {
+                    pipeline_trace_stage(thread->decode_metric, &consumer->trace);
+                    snapshot_cache_offer(thread->stream_name, frame);
+                    if (frames_since_sample >= frame_step && live_detection_due(thread, time(NULL))) {
+                        frames_since_sample = 0;
+                        detect_live_frame(thread, frame, ++frame_count, &consumer->trace);
+                    }
+                    av_frame_unref(frame);
+                }
+            }
+
+            av_packet_unref(pkt);
+            continue;
+        }
 
-        consecutive_failures++;
-        first_check = false;
-        return;
-    }
+        // Key frames only: skip everything but the first key frame after the detection
+        // interval, or one the snapshot cache asks for. A quiet stream is still
+        // checked now and then, in case its packet sizes miss something.
+        if (!(pkt->flags & AV_PKT_FLAG_KEY)) {
+            av_packet_unref(pkt);
+            continue;
+        }
+        time_t now = time(NULL);
+        bool due = live_detection_due(thread, now);
+        if (due && quiet) {
+            int quiet_check = g_config.detection_interval_max > 0 ? g_config.detection_interval_max
+                                                                  : PACKET_ACTIVITY_QUIET_CHECK_SEC;
+            due = now - last_quiet_check >= quiet_check;
+            if (due) {
+                last_quiet_check = now;
+            }
+        }
+        if (!due && !snapshot_cache_wants_frame(thread->stream_name)) {
+            av_packet_unref(pkt);
+            continue;
+        }
 
-    // Reset failure counter when we find segments
-    consecutive_failures = 0;
+        if (decode_key_frame(codec_ctx, pkt, frame) == 0) {
+            pipeline_trace_stage(thread->decode_metric, &consumer->trace);
+            snapshot_cache_offer(thread->stream_name, frame);
+            if (due) {
+                detect_live_frame(thread, frame, ++frame_count, &consumer->trace);
+            }
+            av_frame_unref(frame);
+        } else {
+            log_debug("[Stream %s] Failed to decode key frame for detection", thread->stream_name);
+        }
 
-    log_info("[Stream %s] Found %d segments, newest segment time: %s",
-             thread->stream_name, segment_count, ctime(&newest_time));
+        av_packet_unref(pkt);
+    }
 
-    // Process the segment if needed
-    static char last_processed_segment[MAX_PATH_LENGTH] = {0};
-    process_segment_if_needed(thread, newest_segment, last_processed_segment,
-                             should_run_detection, newest_time, current_time);
+    avcodec_free_context(&codec_ctx);
+    packet_pool_put_frame(thread->packet_pool, &frame);
+    packet_pool_put_packet(thread->packet_pool, &pkt);
+    stream_ingest_detach(consumer);
 
-    first_check = false;
+    log_info("[Stream %s] Live detection stopped after %d sampled frames", thread->stream_name, frame_count);
+    return 0;
 }
 
 /**
@@ -833,6 +1686,7 @@ static void *stream_detection_thread_func(void *arg) {
     int model_load_retries = 0;
     const int MAX_MODEL_LOAD_RETRIES = 5;
 
+    thread_set_identity(THREAD_CLASS_DETECTION, "det", thread->stream_name);
     log_info("[Stream %s] Detection thread started", thread->stream_name);
 
     // Thread initialization
@@ -840,7 +1694,8 @@ static void *stream_detection_thread_func(void *arg) {
     // Register with shutdown coordinator
     char component_name[128];
     snprintf(component_name, sizeof(component_name), "detection_thread_%s", thread->stream_name);
-    thread->component_id = register_component(component_name, COMPONENT_DETECTION_THREAD, NULL, 100);
+    thread->component_id = register_component(component_name, COMPONENT_DETECTION_THREAD, NULL,
+                                              COMPONENT_PRIORITY_DETECTION);
 
     if (thread->component_id >= 0) {
         log_info("[Stream %s] Registered with shutdown coordinator (ID: %d)",
@@ -855,9 +1710,10 @@ static void *stream_detection_thread_func(void *arg) {
         // Check if this is an API URL or the special "api-detection" string
         bool is_api_detection = ends_with(thread->model_path, "api-detection");
         bool is_onvif_detection = ends_with(thread->model_path, "onvif");
+        bool is_remote_detection = remote_detection_address(thread->model_path) != NULL;
 
         // Only check file existence if it's not an API detection
-        if (!is_api_detection && !is_onvif_detection) {
+        if (!is_api_detection && !is_onvif_detection && !is_remote_detection) {
             // Check if model file exists
             struct stat st;
             if (stat(thread->model_path, &st) != 0) {
@@ -915,6 +1771,7 @@ static void *stream_detection_thread_func(void *arg) {
                      thread->stream_name, thread->model_path);
             model_load_retries++;
         } else {
+            thread->model_last_used = time(NULL);
             log_info("[Stream %s] Successfully loaded detection model: %p",
                     thread->stream_name, (void*)thread->model);
 
@@ -931,6 +1788,7 @@ static void *stream_detection_thread_func(void *arg) {
 
     // Main thread loop with improved monitoring and error handling
     time_t last_segment_check = 0;
+    int64_t last_indexed_sequence = -1;
     time_t last_model_retry = 0;
     time_t last_log_time = 0;
     time_t startup_time = time(NULL);
@@ -942,7 +1800,21 @@ static void *stream_detection_thread_func(void *arg) {
     // This gives the system time to initialize without blocking the main thread
     global_startup_delay_end = startup_time + 10;
 
-    while (thread->running) {
+    // Prefer decoding the live stream from the shared ingest; fall back to
+    // polling HLS segments on disk when it is not available. A detection
+    // sub-stream is never part of the HLS output, so it always uses the ingest,
+    // and so do streams whose HLS segments are kept in memory.
+    stream_config_t stream_config;
+    bool has_substream = get_stream_config_by_name(thread->stream_name, &stream_config) == 0 &&
+                         stream_config.detection_url[0] != '\0';
+    bool live_detection = (stream_ingest_enabled() || has_substream || g_config.hls_memory_store) &&
+                          run_live_detection(thread) == 0;
+    if (!live_detection && has_substream) {
+        log_warn("[Stream %s] Detection sub-stream unavailable, detecting on main stream HLS segments",
+                thread->stream_name);
+    }
+
+    while (!live_detection && thread->running) {
         // CRITICAL FIX: Add safety check for thread validity
         if (!thread || !thread->stream_name[0]) {
             log_error("Detection thread has invalid state, exiting");
@@ -964,9 +1836,10 @@ static void *stream_detection_thread_func(void *arg) {
             continue;
         }
 
-        // Check if the HLS directory exists
+        // Check if the HLS directory exists, unless our HLS writer is writing to it
+        bool segments_indexed = hls_segment_index_is_active(thread->stream_name);
         struct stat st;
-        if (stat(thread->hls_dir, &st) != 0) {
+        if (!segments_indexed && stat(thread->hls_dir, &st) != 0) {
             log_warn("[Stream %s] HLS directory does not exist: %s (error: %s)",
                     thread->stream_name, thread->hls_dir, strerror(errno));
             usleep(1000000); // Sleep for 1 second before checking again
@@ -998,15 +1871,15 @@ static void *stream_detection_thread_func(void *arg) {
                         thread->model ? "yes" : "no",
                         thread->last_detection_time > 0 ? ctime(&thread->last_detection_time) : "never",
                         time_since_detection,
-                        thread->detection_interval);
-            } else if (time_since_detection > (thread->detection_interval * 2)) {
+                        detection_check_interval(thread));
+            } else if (time_since_detection > (detection_check_interval(thread) * 2)) {
                 // No detection in progress but we're behind schedule
                 log_warn("[Stream %s] Thread status: model loaded: %s, no detection in progress, last detection: %s (%ld seconds ago), interval: %d seconds",
                         thread->stream_name,
                         thread->model ? "yes" : "no",
                         thread->last_detection_time > 0 ? ctime(&thread->last_detection_time) : "never",
                         time_since_detection,
-                        thread->detection_interval);
+                        detection_check_interval(thread));
             } else {
                 // Normal status
                 log_info("[Stream %s] Thread status: model loaded: %s, no detection in progress, last detection: %s (%ld seconds ago), interval: %d seconds",
@@ -1014,7 +1887,7 @@ static void *stream_detection_thread_func(void *arg) {
                         thread->model ? "yes" : "no",
                         thread->last_detection_time > 0 ? ctime(&thread->last_detection_time) : "never",
                         time_since_detection,
-                        thread->detection_interval);
+                        detection_check_interval(thread));
             }
         }
 
@@ -1036,8 +1909,17 @@ static void *stream_detection_thread_func(void *arg) {
             // This is handled inside check_for_new_segments
         }
 
-        int sleep_time = 500000; // Default 500ms
-        usleep(sleep_time);
+        // Sleep until the HLS writer completes a segment, or poll when the segments are not ours
+        if (segments_indexed) {
+            hls_segment_info_t latest;
+            if (hls_segment_index_wait(thread->stream_name, last_indexed_sequence, 500, &latest) == 0) {
+                last_indexed_sequence = latest.sequence;
+                last_segment_check = 0; // Check the new segment right away
+            }
+        } else {
+            int sleep_time = 500000; // Default 500ms
+            usleep(sleep_time);
+        }
     }
 
     // Update component state in shutdown coordinator
@@ -1051,6 +1933,13 @@ static void *stream_detection_thread_func(void *arg) {
         log_error("Cannot clean up NULL thread");
         return NULL;
     }
+    // No worker may still be detecting on this thread's model
+    detection_scheduler_cancel(thread->stream_id);
+
+    if (thread->motion_gate != MOTION_GATE_OFF) {
+        set_motion_detection_enabled(thread->stream_name, false);
+    }
+
     // Unload the model with enhanced cleanup for SOD models
     pthread_mutex_lock(&thread->mutex);
     if (thread->model) {
@@ -1070,8 +1959,20 @@ static void *stream_detection_thread_func(void *arg) {
 
         thread->model = NULL;
     }
+    sws_freeContext(thread->sws_ctx);
+    thread->sws_ctx = NULL;
+    if (thread->rgb_buffer) {
+        memory_track(MEMORY_TAG_DETECTION, thread->rgb_buffer_size, false);
+    }
+    free(thread->rgb_buffer);
+    thread->rgb_buffer = NULL;
+    thread->rgb_buffer_size = 0;
     pthread_mutex_unlock(&thread->mutex);
 
+    frame_export_close(thread->stream_name);
+    snapshot_cache_close(thread->stream_name);
+    object_tracker_reset(thread->stream_name);
+
     log_info("[Stream %s] Detection thread exiting", thread->stream_name);
     return NULL;
 }
@@ -1086,8 +1987,20 @@ int init_stream_detection_system(void) {
 
     pthread_mutex_lock(&stream_threads_mutex);
 
+    // One thread structure per stream ID
+    if (!stream_threads) {
+        thread_capacity = stream_registry_capacity();
+        stream_threads = calloc(thread_capacity, sizeof(stream_detection_thread_t));
+        if (!stream_threads) {
+            log_error("Failed to allocate detection threads for %d streams", thread_capacity);
+            thread_capacity = 0;
+            pthread_mutex_unlock(&stream_threads_mutex);
+            return -1;
+        }
+    }
+
     // Initialize all thread structures
-    for (int i = 0; i < MAX_STREAM_THREADS; i++) {
+    for (int i = 0; i < thread_capacity; i++) {
         memset(&stream_threads[i], 0, sizeof(stream_detection_thread_t));
         pthread_mutex_init(&stream_threads[i].mutex, NULL);
         pthread_cond_init(&stream_threads[i].cond, NULL);
@@ -1096,6 +2009,11 @@ int init_stream_detection_system(void) {
     system_initialized = true;
     pthread_mutex_unlock(&stream_threads_mutex);
 
+    // Conversion and inference of all streams run on one shared worker pool
+    if (detection_scheduler_init(device_profile_value(DEVICE_KNOB_DETECTION_WORKERS), g_config.detection_max_fps) != 0) {
+        log_warn("Failed to start detection workers, running detection on the stream threads");
+    }
+
     log_info("Stream detection system initialized");
     return 0;
 }
@@ -1108,10 +2026,17 @@ void shutdown_stream_detection_system(void) {
         return;
     }
 
+    // A replay uses the workers too
+    detection_replay_shutdown();
+
+    // Let the workers finish their current jobs before the models go away;
+    // the stream threads run any further detections inline
+    detection_scheduler_shutdown();
+
     pthread_mutex_lock(&stream_threads_mutex);
 
     // Stop all running threads
-    for (int i = 0; i < MAX_STREAM_THREADS; i++) {
+    for (int i = 0; i < thread_capacity; i++) {
         if (stream_threads[i].running) {
             log_info("Stopping detection thread for stream %s", stream_threads[i].stream_name);
 
@@ -1183,6 +2108,7 @@ void shutdown_stream_detection_system(void) {
             // Cleanup resources
             pthread_mutex_destroy(&stream_threads[i].mutex);
             pthread_cond_destroy(&stream_threads[i].cond);
+            stream_registry_release(stream_threads[i].stream_id);
         }
     }
 
@@ -1190,12 +2116,64 @@ void shutdown_stream_detection_system(void) {
     log_info("Forcing cleanup of all SOD models during shutdown");
     force_sod_models_cleanup();
 
+    frame_export_shutdown();
+    snapshot_cache_shutdown();
+
     system_initialized = false;
     pthread_mutex_unlock(&stream_threads_mutex);
 
     log_info("Stream detection system shutdown");
 }
 
+// Per-stream detection settings read from the stream configuration
+typedef struct {
+    int frame_step;
+    int priority;
+    motion_gate_t motion_gate;
+    char motion_mask[MAX_MOTION_MASK_TEXT];
+    detection_zone_t zones[MAX_DETECTION_ZONES];
+    int zone_count;
+} stream_detection_settings_t;
+
+/**
+ * Read the detection settings of a stream that are not passed by the callers
+ * Enables the stream's motion detector when the motion gate is on.
+ */
+static void read_stream_detection_settings(const char *stream_name, stream_detection_settings_t *settings) {
+    memset(settings, 0, sizeof(*settings));
+    settings->priority = 5;
+    settings->motion_gate = MOTION_GATE_OFF;
+
+    stream_config_t stream_config;
+    if (get_stream_config_by_name(stream_name, &stream_config) == 0) {
+        if (stream_config.detection_frame_step > 0) {
+            settings->frame_step = stream_config.detection_frame_step;
+        }
+        settings->priority = stream_config.priority;
+        settings->motion_gate = stream_config.detection_motion_gate;
+        memcpy(settings->motion_mask, stream_config.motion_mask, sizeof(settings->motion_mask));
+        settings->zone_count = parse_detection_zones(stream_config.detection_zones, settings->zones,
+                                                     MAX_DETECTION_ZONES);
+        if (settings->zone_count < 0) {
+            log_warn("Invalid detection zones for stream %s, detecting in the whole frame: %s",
+                    stream_name, stream_config.detection_zones);
+            settings->zone_count = 0;
+        }
+    }
+
+    // The gate runs the stream's motion detector on the sampled frames
+    if (settings->motion_gate != MOTION_GATE_OFF && set_motion_detection_enabled(stream_name, true) != 0) {
+        log_warn("Failed to enable motion detection for stream %s, object detection is not gated", stream_name);
+        settings->motion_gate = MOTION_GATE_OFF;
+    }
+
+    // Cells masked from motion detection neither open the gate nor cost processing time
+    if (settings->motion_gate != MOTION_GATE_OFF && configure_motion_mask(stream_name, settings->motion_mask) != 0) {
+        log_warn("Invalid motion mask for stream %s, detecting motion in the whole frame", stream_name);
+        configure_motion_mask(stream_name, NULL);
+    }
+}
+
 /**
  * Start a detection thread for a stream
  */
@@ -1243,54 +2221,76 @@ int start_stream_detection_thread(const char *stream_name, const char *model_pat
         }
     }
 
-    pthread_mutex_lock(&stream_threads_mutex);
-
-    // Check if a thread is already running for this stream
-    for (int i = 0; i < MAX_STREAM_THREADS; i++) {
-        if (stream_threads[i].running && strcmp(stream_threads[i].stream_name, stream_name) == 0) {
-            log_info("Detection thread already running for stream %s", stream_name);
-            pthread_mutex_unlock(&stream_threads_mutex);
-            return 0;
-        }
-    }
+    // Sampling mode, priority, motion gating and zones are per-stream settings that are not passed by the callers
+    stream_detection_settings_t settings;
+    read_stream_detection_settings(stream_name, &settings);
 
-    // Find an available thread slot
-    int slot = -1;
-    for (int i = 0; i < MAX_STREAM_THREADS; i++) {
-        if (!stream_threads[i].running) {
-            slot = i;
-            break;
-        }
-    }
+    pthread_mutex_lock(&stream_threads_mutex);
 
-    if (slot == -1) {
+    // The thread slot is the stream ID; the reference is held while the thread runs
+    int slot = stream_registry_acquire(stream_name);
+    if (slot < 0 || slot >= thread_capacity) {
         log_error("No available thread slots for stream %s", stream_name);
+        stream_registry_release(slot);
         pthread_mutex_unlock(&stream_threads_mutex);
         return -1;
     }
 
+    // Check if a thread is already running for this stream
+    if (stream_threads[slot].running) {
+        log_info("Detection thread already running for stream %s", stream_name);
+        stream_registry_release(slot);
+        pthread_mutex_unlock(&stream_threads_mutex);
+        return 0;
+    }
+
     // Initialize thread structure
     stream_detection_thread_t *thread = &stream_threads[slot];
     strncpy(thread->stream_name, stream_name, MAX_STREAM_NAME - 1);
     thread->stream_name[MAX_STREAM_NAME - 1] = '\0';
+    thread->stream_id = slot;
 
     strncpy(thread->model_path, model_path, MAX_PATH_LENGTH - 1);
     thread->model_path[MAX_PATH_LENGTH - 1] = '\0';
 
+    const char *model_name = strrchr(thread->model_path, '/');
+    thread->latency_metric = metrics_histogram("lightnvr_detection_seconds",
+                                               "Time to run the detection model on a frame",
+                                               "stream", stream_name,
+                                               "model", model_name ? model_name + 1 : thread->model_path, NULL);
+    thread->decode_metric = pipeline_trace_metric(stream_name, PIPELINE_STAGE_DECODE);
+    thread->inference_metric = pipeline_trace_metric(stream_name, PIPELINE_STAGE_INFERENCE);
+
     strncpy(thread->hls_dir, hls_dir, MAX_PATH_LENGTH - 1);
     thread->hls_dir[MAX_PATH_LENGTH - 1] = '\0';
 
     thread->threshold = threshold;
     thread->detection_interval = detection_interval;
+    thread->check_interval = 0;
+    thread->last_check_time = 0;
+    thread->frame_step = settings.frame_step;
+    thread->priority = settings.priority;
+    thread->priority_checked = 0;
+    thread->motion_gate = settings.motion_gate;
+    thread->motion_hold_until = 0;
+    thread->motion_vectors = false;
+    memcpy(thread->zones, settings.zones, sizeof(detection_zone_t) * settings.zone_count);
+    thread->zone_count = settings.zone_count;
+    thread->packet_pool = packet_pool_acquire(stream_name);
     thread->running = true;
     thread->model = NULL;
+    thread->sws_ctx = NULL;
+    thread->rgb_buffer = NULL;
+    thread->rgb_buffer_size = 0;
     thread->last_detection_time = 0;
     atomic_init(&thread->detection_in_progress, 0); // Initialize atomic flag to 0 (no detection in progress)
 
     // Create the thread
-    if (pthread_create(&thread->thread, NULL, stream_detection_thread_func, thread) != 0) {
+    if (pthread_create_with_stack(&thread->thread, stream_detection_thread_func, thread,
+                                  DETECTION_THREAD_STACK_SIZE, false) != 0) {
         log_error("Failed to create detection thread for stream %s", stream_name);
         thread->running = false;
+        stream_registry_release(slot);
         pthread_mutex_unlock(&stream_threads_mutex);
         return -1;
     }
@@ -1301,71 +2301,380 @@ int start_stream_detection_thread(const char *stream_name, const char *model_pat
 }
 
 /**
- * Stop a detection thread for a stream
+ * Apply new detection settings to a running detection thread
  */
-int stop_stream_detection_thread(const char *stream_name) {
+int update_stream_detection_thread(const char *stream_name, float threshold, int detection_interval) {
     if (!system_initialized || !stream_name) {
         return -1;
     }
 
+    stream_detection_settings_t settings;
+    read_stream_detection_settings(stream_name, &settings);
+
     pthread_mutex_lock(&stream_threads_mutex);
 
-    // Find the thread for this stream
-    for (int i = 0; i < MAX_STREAM_THREADS; i++) {
-        if (stream_threads[i].running && strcmp(stream_threads[i].stream_name, stream_name) == 0) {
-            log_info("Stopping detection thread for stream %s", stream_name);
+    int slot = find_stream_thread_slot(stream_name);
+    if (slot < 0) {
+        pthread_mutex_unlock(&stream_threads_mutex);
+        if (settings.motion_gate != MOTION_GATE_OFF) {
+            set_motion_detection_enabled(stream_name, false);
+        }
+        return -1;
+    }
 
-            // First, check if the thread has a model loaded and ensure it's properly cleaned up
-            // This is a safety measure in case the thread doesn't clean up its own model
-            pthread_mutex_lock(&stream_threads[i].mutex);
+    // The thread mutex is held while the model runs, so this waits for the current detection
+    stream_detection_thread_t *thread = &stream_threads[slot];
+    pthread_mutex_lock(&thread->mutex);
+    bool gate_was_on = thread->motion_gate != MOTION_GATE_OFF;
+    thread->threshold = threshold;
+    if (thread->model) {
+        set_detection_model_threshold(thread->model, threshold);
+    }
+    thread->detection_interval = detection_interval;
+    thread->check_interval = 0;
+    thread->frame_step = settings.frame_step;
+    thread->priority = settings.priority;
+    thread->motion_gate = settings.motion_gate;
+    memcpy(thread->zones, settings.zones, sizeof(detection_zone_t) * settings.zone_count);
+    thread->zone_count = settings.zone_count;
+    pthread_mutex_unlock(&thread->mutex);
 
-            // CRITICAL FIX: Make a local copy of the model pointer to prevent race conditions
-            detection_model_t model_to_cleanup = NULL;
-            if (stream_threads[i].model) {
-                log_info("Ensuring model cleanup before stopping thread for stream %s", stream_name);
-                model_to_cleanup = stream_threads[i].model;
+    pthread_mutex_unlock(&stream_threads_mutex);
 
-                // Immediately set the thread's model to NULL to prevent double-free
-                // This ensures that even if another thread tries to access it, it will be NULL
-                stream_threads[i].model = NULL;
-            }
-            pthread_mutex_unlock(&stream_threads[i].mutex);
+    if (gate_was_on && settings.motion_gate == MOTION_GATE_OFF) {
+        set_motion_detection_enabled(stream_name, false);
+    }
 
-            // Now clean up the model outside the mutex lock if we have one to clean up
-            if (model_to_cleanup) {
-                // Get the model type to check if it's a SOD model
-                const char *model_type = get_model_type_from_handle(model_to_cleanup);
+    log_info("Updated detection settings of stream %s: threshold %.2f, interval %d, frame step %d, "
+             "motion gate %d, %d zones", stream_name, threshold, detection_interval,
+             settings.frame_step, (int)settings.motion_gate, settings.zone_count);
+    return 0;
+}
 
-                // Use our enhanced cleanup for SOD models to prevent memory leaks
-                if (strcmp(model_type, MODEL_TYPE_SOD) == 0) {
-                    log_info("Using enhanced SOD model cleanup to prevent memory leaks");
-                    ensure_sod_model_cleanup(model_to_cleanup);
-                } else if (strcmp(model_type, "unknown") != 0) {
-                    // For non-SOD models (except unknown type), use standard unload
-                    log_info("Using standard unload for non-SOD model type: %s", model_type);
-                    unload_detection_model(model_to_cleanup);
-                } else {
-                    // For unknown model type, use the safest approach
-                    log_warn("Unknown model type detected, using generic unload");
-                    unload_detection_model(model_to_cleanup);
-                }
+// Model swap in flight, handed to the loader thread
+typedef struct {
+    char stream_name[MAX_STREAM_NAME];
+    char model_path[MAX_PATH_LENGTH];
+    float threshold;
+    int slot;
+    unsigned int swap;
+} model_swap_t;
+
+static unsigned int model_swap_counter = 0;
+
+/**
+ * Unload a model that no detection is using any more
+ */
+static void release_stream_model(detection_model_t model) {
+    if (strcmp(get_model_type_from_handle(model), MODEL_TYPE_SOD) == 0) {
+        ensure_sod_model_cleanup(model);
+    } else {
+        unload_detection_model(model);
+    }
+}
 
-                // The model pointer is now invalid, no need to set it to NULL as we already did that
-                log_info("Model cleanup completed for stream %s", stream_name);
+/**
+ * Load the new model of a swap, then hand it to the stream's thread
+ */
+static void *model_swap_thread(void *arg) {
+    model_swap_t *swap = (model_swap_t *)arg;
+    thread_set_identity(THREAD_CLASS_DETECTION, "model", swap->stream_name);
+
+    // Loading includes the warm-up, so the first detection with the new
+    // model is as fast as the ones after it
+    detection_model_t model = load_detection_model(swap->model_path, swap->threshold);
+    if (!model) {
+        log_error("Failed to load model %s for stream %s, keeping the current model",
+                  swap->model_path, swap->stream_name);
+
+        // Let the same model be asked for again
+        pthread_mutex_lock(&stream_threads_mutex);
+        if (system_initialized && swap->slot < thread_capacity) {
+            stream_detection_thread_t *thread = &stream_threads[swap->slot];
+            pthread_mutex_lock(&thread->mutex);
+            if (thread->model_swap == swap->swap) {
+                thread->model_swap = 0;
             }
+            pthread_mutex_unlock(&thread->mutex);
+        }
+        pthread_mutex_unlock(&stream_threads_mutex);
 
-            // Now stop the thread
-            stream_threads[i].running = false;
-            pthread_join(stream_threads[i].thread, NULL);
+        free(swap);
+        return NULL;
+    }
 
-            // Clear the thread structure
-            memset(&stream_threads[i], 0, sizeof(stream_detection_thread_t));
-            pthread_mutex_init(&stream_threads[i].mutex, NULL);
-            pthread_cond_init(&stream_threads[i].cond, NULL);
+    detection_model_t old_model = model;
+    bool swapped = false;
 
-            pthread_mutex_unlock(&stream_threads_mutex);
-            return 0;
+    pthread_mutex_lock(&stream_threads_mutex);
+    if (system_initialized && swap->slot < thread_capacity) {
+        stream_detection_thread_t *thread = &stream_threads[swap->slot];
+
+        // The thread mutex is held while the model runs, so this waits for the current detection
+        pthread_mutex_lock(&thread->mutex);
+        if (thread->running && thread->model_swap == swap->swap &&
+            strcmp(thread->stream_name, swap->stream_name) == 0) {
+            old_model = thread->model;
+            thread->model = model;
+            thread->model_last_used = time(NULL);
+            set_detection_model_threshold(model, thread->threshold);
+            strncpy(thread->model_path, swap->model_path, MAX_PATH_LENGTH - 1);
+            thread->model_path[MAX_PATH_LENGTH - 1] = '\0';
+            thread->model_swap = 0;
+
+            const char *model_name = strrchr(thread->model_path, '/');
+            thread->latency_metric = metrics_histogram("lightnvr_detection_seconds",
+                                                       "Time to run the detection model on a frame",
+                                                       "stream", thread->stream_name,
+                                                       "model", model_name ? model_name + 1 : thread->model_path,
+                                                       NULL);
+            swapped = true;
+        }
+        pthread_mutex_unlock(&thread->mutex);
+    }
+    pthread_mutex_unlock(&stream_threads_mutex);
+
+    if (swapped) {
+        log_info("Stream %s switched to detection model %s", swap->stream_name, swap->model_path);
+    } else {
+        log_info("Discarding model %s loaded for stream %s, the stream moved on",
+                 swap->model_path, swap->stream_name);
+    }
+
+    // Nothing detects with the old model any more
+    if (old_model) {
+        release_stream_model(old_model);
+    }
+
+    free(swap);
+    return NULL;
+}
+
+/**
+ * Switch a running detection thread to another model without stopping it
+ */
+int swap_stream_detection_model(const char *stream_name, const char *model_path) {
+    if (!system_initialized || !stream_name || !model_path || model_path[0] == '\0') {
+        return -1;
+    }
+
+    model_swap_t *swap = calloc(1, sizeof(model_swap_t));
+    if (!swap) {
+        log_error("Failed to allocate model swap for stream %s", stream_name);
+        return -1;
+    }
+
+    pthread_mutex_lock(&stream_threads_mutex);
+
+    int slot = find_stream_thread_slot(stream_name);
+    if (slot < 0) {
+        pthread_mutex_unlock(&stream_threads_mutex);
+        free(swap);
+        return -1;
+    }
+
+    stream_detection_thread_t *thread = &stream_threads[slot];
+    strncpy(swap->stream_name, stream_name, MAX_STREAM_NAME - 1);
+    strncpy(swap->model_path, model_path, MAX_PATH_LENGTH - 1);
+    swap->slot = slot;
+
+    pthread_mutex_lock(&thread->mutex);
+    const char *target = thread->model_swap ? thread->swap_model_path : thread->model_path;
+    if (strcmp(target, swap->model_path) == 0) {
+        pthread_mutex_unlock(&thread->mutex);
+        pthread_mutex_unlock(&stream_threads_mutex);
+        free(swap);
+        return 0;
+    }
+
+    // A later swap supersedes one whose model is still loading
+    swap->threshold = thread->threshold;
+    swap->swap = ++model_swap_counter;
+    if (swap->swap == 0) {
+        swap->swap = ++model_swap_counter;
+    }
+    thread->model_swap = swap->swap;
+    memcpy(thread->swap_model_path, swap->model_path, MAX_PATH_LENGTH);
+    pthread_mutex_unlock(&thread->mutex);
+
+    pthread_mutex_unlock(&stream_threads_mutex);
+
+    pthread_t loader;
+    if (pthread_create_with_stack(&loader, model_swap_thread, swap, DETECTION_THREAD_STACK_SIZE, true) != 0) {
+        log_error("Failed to start loading model %s for stream %s", model_path, stream_name);
+        free(swap);
+        return -1;
+    }
+
+    log_info("Loading detection model %s for stream %s in the background", model_path, stream_name);
+    return 0;
+}
+
+/**
+ * Unload detection models that have not run for a while
+ */
+void evict_idle_detection_models(void) {
+    int idle_timeout = g_config.model_idle_timeout;
+    size_t budget = g_config.model_memory_budget > 0 ?
+                    (size_t)g_config.model_memory_budget * 1024 * 1024 : 0;
+    if (idle_timeout <= 0 && budget == 0) {
+        return;
+    }
+
+    typedef struct {
+        int slot;
+        time_t last_used;
+        size_t bytes;
+    } model_use_t;
+
+    pthread_mutex_lock(&stream_threads_mutex);
+    if (!system_initialized || thread_capacity <= 0) {
+        pthread_mutex_unlock(&stream_threads_mutex);
+        return;
+    }
+
+    model_use_t *uses = calloc(thread_capacity, sizeof(model_use_t));
+    detection_model_t *evicted = calloc(thread_capacity, sizeof(detection_model_t));
+    if (!uses || !evicted) {
+        pthread_mutex_unlock(&stream_threads_mutex);
+        free(uses);
+        free(evicted);
+        return;
+    }
+
+    // A thread whose mutex is taken is detecting, so its model is in use
+    size_t loaded = 0;
+    int count = 0;
+    for (int i = 0; i < thread_capacity; i++) {
+        stream_detection_thread_t *thread = &stream_threads[i];
+        if (!thread->running || pthread_mutex_trylock(&thread->mutex) != 0) {
+            continue;
+        }
+        if (thread->model) {
+            size_t bytes = get_model_memory_size(thread->model);
+            loaded += bytes;
+            uses[count].slot = i;
+            uses[count].last_used = thread->model_last_used;
+            uses[count].bytes = bytes;
+            count++;
+        }
+        pthread_mutex_unlock(&thread->mutex);
+    }
+
+    // Least recently used first
+    for (int i = 1; i < count; i++) {
+        model_use_t use = uses[i];
+        int j = i - 1;
+        while (j >= 0 && uses[j].last_used > use.last_used) {
+            uses[j + 1] = uses[j];
+            j--;
+        }
+        uses[j + 1] = use;
+    }
+
+    time_t now = time(NULL);
+    int evicted_count = 0;
+    for (int i = 0; i < count; i++) {
+        long idle = (long)(now - uses[i].last_used);
+        bool expired = idle_timeout > 0 && idle >= idle_timeout;
+        bool over_budget = budget > 0 && loaded > budget && idle >= MODEL_EVICT_MIN_IDLE_SEC;
+        if (!expired && !over_budget) {
+            // Every model after this one was used more recently
+            break;
+        }
+
+        stream_detection_thread_t *thread = &stream_threads[uses[i].slot];
+        if (pthread_mutex_trylock(&thread->mutex) != 0) {
+            continue;
+        }
+        if (thread->model && thread->model_last_used == uses[i].last_used) {
+            log_info("[Stream %s] Unloading detection model %s, unused for %ld s%s",
+                     thread->stream_name, thread->model_path, idle,
+                     expired ? "" : " and over the model memory budget");
+            evicted[evicted_count++] = thread->model;
+            thread->model = NULL;
+            loaded -= uses[i].bytes;
+        }
+        pthread_mutex_unlock(&thread->mutex);
+    }
+
+    pthread_mutex_unlock(&stream_threads_mutex);
+
+    // Nothing detects with these models any more
+    for (int i = 0; i < evicted_count; i++) {
+        release_stream_model(evicted[i]);
+    }
+
+    free(uses);
+    free(evicted);
+}
+
+/**
+ * Stop a detection thread for a stream
+ */
+int stop_stream_detection_thread(const char *stream_name) {
+    if (!system_initialized || !stream_name) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&stream_threads_mutex);
+
+    // Find the thread for this stream
+    int i = find_stream_thread_slot(stream_name);
+    if (i >= 0) {
+        log_info("Stopping detection thread for stream %s", stream_name);
+
+        // First, check if the thread has a model loaded and ensure it's properly cleaned up
+        // This is a safety measure in case the thread doesn't clean up its own model
+        pthread_mutex_lock(&stream_threads[i].mutex);
+
+        // CRITICAL FIX: Make a local copy of the model pointer to prevent race conditions
+        detection_model_t model_to_cleanup = NULL;
+        if (stream_threads[i].model) {
+            log_info("Ensuring model cleanup before stopping thread for stream %s", stream_name);
+            model_to_cleanup = stream_threads[i].model;
+
+            // Immediately set the thread's model to NULL to prevent double-free
+            // This ensures that even if another thread tries to access it, it will be NULL
+            stream_threads[i].model = NULL;
+        }
+        pthread_mutex_unlock(&stream_threads[i].mutex);
+
+        // Now clean up the model outside the mutex lock if we have one to clean up
+        if (model_to_cleanup) {
+            // Get the model type to check if it's a SOD model
+            const char *model_type = get_model_type_from_handle(model_to_cleanup);
+
+            // Use our enhanced cleanup for SOD models to prevent memory leaks
+            if (strcmp(model_type, MODEL_TYPE_SOD) == 0) {
+                log_info("Using enhanced SOD model cleanup to prevent memory leaks");
+                ensure_sod_model_cleanup(model_to_cleanup);
+            } else if (strcmp(model_type, "unknown") != 0) {
+                // For non-SOD models (except unknown type), use standard unload
+                log_info("Using standard unload for non-SOD model type: %s", model_type);
+                unload_detection_model(model_to_cleanup);
+            } else {
+                // For unknown model type, use the safest approach
+                log_warn("Unknown model type detected, using generic unload");
+                unload_detection_model(model_to_cleanup);
+            }
+
+            // The model pointer is now invalid, no need to set it to NULL as we already did that
+            log_info("Model cleanup completed for stream %s", stream_name);
         }
+
+        // Now stop the thread
+        stream_threads[i].running = false;
+        pthread_join(stream_threads[i].thread, NULL);
+
+        // Clear the thread structure
+        memset(&stream_threads[i], 0, sizeof(stream_detection_thread_t));
+        pthread_mutex_init(&stream_threads[i].mutex, NULL);
+        pthread_cond_init(&stream_threads[i].cond, NULL);
+        stream_registry_release(i);
+
+        pthread_mutex_unlock(&stream_threads_mutex);
+        return 0;
     }
 
     log_warn("No detection thread found for stream %s", stream_name);
@@ -1384,15 +2693,10 @@ bool is_stream_detection_thread_running(const char *stream_name) {
     pthread_mutex_lock(&stream_threads_mutex);
 
     // Find the thread for this stream
-    for (int i = 0; i < MAX_STREAM_THREADS; i++) {
-        if (stream_threads[i].running && strcmp(stream_threads[i].stream_name, stream_name) == 0) {
-            pthread_mutex_unlock(&stream_threads_mutex);
-            return true;
-        }
-    }
+    bool running = find_stream_thread_slot(stream_name) >= 0;
 
     pthread_mutex_unlock(&stream_threads_mutex);
-    return false;
+    return running;
 }
 
 /**
@@ -1406,7 +2710,7 @@ int get_running_stream_detection_threads(void) {
     pthread_mutex_lock(&stream_threads_mutex);
 
     int count = 0;
-    for (int i = 0; i < MAX_STREAM_THREADS; i++) {
+    for (int i = 0; i < thread_capacity; i++) {
         if (stream_threads[i].running) {
             count++;
         }
@@ -1438,17 +2742,16 @@ int get_stream_detection_status(const char *stream_name, bool *has_thread,
     pthread_mutex_lock(&stream_threads_mutex);
 
     // Find the thread for this stream
-    for (int i = 0; i < MAX_STREAM_THREADS; i++) {
-        if (stream_threads[i].running && strcmp(stream_threads[i].stream_name, stream_name) == 0) {
-            *has_thread = true;
-            *last_detection_time = stream_threads[i].last_detection_time;
+    int slot = find_stream_thread_slot(stream_name);
+    if (slot >= 0) {
+        *has_thread = true;
+        *last_detection_time = stream_threads[slot].last_detection_time;
 
-            // We don't track last_check_time separately, so use last_detection_time
-            *last_check_time = stream_threads[i].last_detection_time;
+        // We don't track last_check_time separately, so use last_detection_time
+        *last_check_time = stream_threads[slot].last_detection_time;
 
-            pthread_mutex_unlock(&stream_threads_mutex);
-            return 0;
-        }
+        pthread_mutex_unlock(&stream_threads_mutex);
+        return 0;
     }
 
     pthread_mutex_unlock(&stream_threads_mutex);
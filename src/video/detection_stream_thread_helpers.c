@@ -19,24 +19,31 @@
 
 #include "core/logger.h"
 #include "core/config.h"
+#include "core/event_bus.h"
 #include "video/detection_stream_thread.h"
 #include "video/detection_stream_thread_helpers.h"
 #include "video/streams.h"
 #include "video/hls_writer.h"
+#include "video/hls/hls_segment_index.h"
 #include "utils/strings.h"
 #include "video/detection_model.h"
 #include "video/onvif_detection.h"
+#include "video/load_governor.h"
+#include "database/db_streams.h"
 #include "video/stream_state.h"
+#include "video/stream_supervisor.h"
 
 // Forward declaration of the internal function - this is defined in detection_stream_thread.c
 extern int process_segment_for_detection(stream_detection_thread_t *thread, const char *segment_path);
 
 // Forward declaration for recording function - this is defined in detection_stream_thread.c
-extern int process_frame_for_recording(const char *stream_name, const uint8_t *frame_data, int width, int height, int channels, time_t timestamp, detection_result_t *result);
 
 // Forward declaration of global variable from detection_stream_thread.c
 extern time_t global_startup_delay_end;
 
+// Seconds between priority lookups while low-priority streams are paused
+#define PRIORITY_REFRESH_SECONDS 30
+
 /**
  * Check if detection should run based on startup delay, detection in progress, and time interval
  * Returns true if detection should run, false otherwise
@@ -78,19 +85,25 @@ bool should_run_detection_check(stream_detection_thread_t *thread, time_t curren
         return false;
     }
 
+    if (detection_paused_by_load(thread, current_time)) {
+        log_debug("[Stream %s] Detection paused by load shedding (priority %d)",
+                 thread->stream_name, thread->priority);
+        return false;
+    }
+
     // Check if enough time has passed since the last detection
     if (thread->last_detection_time > 0) {
         time_t time_since_last = current_time - thread->last_detection_time;
-        if (time_since_last < thread->detection_interval) {
+        if (!detection_interval_elapsed(thread, current_time)) {
             // Not enough time has passed for detection
             log_info("[Stream %s] Checking for segments (last detection was %ld seconds ago, interval: %d seconds)",
-                     thread->stream_name, time_since_last, thread->detection_interval);
+                     thread->stream_name, time_since_last, detection_check_interval(thread));
             return false;
         }
 
         // Enough time has passed and no detection is running
         log_info("[Stream %s] Time for a new detection (%ld seconds since last, interval: %d seconds)",
-                thread->stream_name, time_since_last, thread->detection_interval);
+                thread->stream_name, time_since_last, detection_check_interval(thread));
         return true;
     }
 
@@ -99,6 +112,96 @@ bool should_run_detection_check(stream_detection_thread_t *thread, time_t curren
     return true;
 }
 
+/**
+ * Bounds of the adaptive interval of a stream
+ */
+static void adaptive_interval_bounds(const stream_detection_thread_t *thread, int *min, int *max) {
+    *min = g_config.detection_interval_min > 0 ? g_config.detection_interval_min : thread->detection_interval;
+    if (*min < 1) {
+        *min = 1;
+    }
+    *max = g_config.detection_interval_max > *min ? g_config.detection_interval_max : *min;
+}
+
+/**
+ * Interval the stream's activity has set, within the adaptive bounds
+ */
+static int adaptive_interval(const stream_detection_thread_t *thread, int min, int max) {
+    if (thread->check_interval < min) {
+        return min;
+    }
+    return thread->check_interval > max ? max : thread->check_interval;
+}
+
+int detection_check_interval(const stream_detection_thread_t *thread) {
+    int interval = thread->detection_interval;
+    if (g_config.detection_adaptive_interval) {
+        int min, max;
+        adaptive_interval_bounds(thread, &min, &max);
+        interval = adaptive_interval(thread, min, max);
+    }
+
+    // Under load every stream detects at half its rate
+    if (load_governor_level() >= LOAD_SHED_REDUCE_RATE) {
+        interval = interval > 0 ? interval * 2 : 1;
+    }
+    return interval;
+}
+
+bool detection_interval_elapsed(const stream_detection_thread_t *thread, time_t now) {
+    if (!g_config.detection_adaptive_interval) {
+        return thread->last_detection_time <= 0 ||
+               now - thread->last_detection_time >= detection_check_interval(thread);
+    }
+    return thread->last_check_time <= 0 ||
+           now - thread->last_check_time >= detection_check_interval(thread);
+}
+
+bool detection_paused_by_load(stream_detection_thread_t *thread, time_t now) {
+    if (load_governor_level() < LOAD_SHED_PAUSE_LOW_PRIORITY) {
+        return false;
+    }
+
+    // Pick up priorities changed with set_stream_priority while shedding
+    if (now - thread->priority_checked >= PRIORITY_REFRESH_SECONDS) {
+        stream_config_t config;
+        if (get_stream_config_by_name(thread->stream_name, &config) == 0) {
+            thread->priority = config.priority;
+        }
+        thread->priority_checked = now;
+    }
+    return load_governor_detection_paused(thread->priority);
+}
+
+int detection_frame_step(const stream_detection_thread_t *thread) {
+    return load_governor_level() >= LOAD_SHED_KEY_FRAMES ? 0 : thread->frame_step;
+}
+
+void update_detection_interval(stream_detection_thread_t *thread, time_t now, bool active) {
+    if (!g_config.detection_adaptive_interval) {
+        return;
+    }
+
+    int min, max;
+    adaptive_interval_bounds(thread, &min, &max);
+    int interval = adaptive_interval(thread, min, max);
+    thread->last_check_time = now;
+
+    if (active) {
+        if (interval > min) {
+            log_info("[Stream %s] Activity, detection interval back to %d seconds", thread->stream_name, min);
+        }
+        thread->check_interval = min;
+        return;
+    }
+
+    int next = interval < max / 2 ? interval * 2 : max;
+    if (next != interval) {
+        log_debug("[Stream %s] Quiet, detection interval now %d seconds", thread->stream_name, next);
+    }
+    thread->check_interval = next;
+}
+
 /**
  * Check and manage HLS writer status
  * Returns true if HLS writer is recording, false otherwise
@@ -131,45 +234,18 @@ bool check_hls_writer_status(stream_detection_thread_t *thread, time_t current_t
     // Check if the HLS writer is recording
     hls_writer_recording = is_hls_stream_active(thread->stream_name);
     if (!hls_writer_recording) {
+        // The supervisor restarts the HLS thread, with backoff if it keeps failing
+        bool supervised = supervisor_report_stall(thread->stream_name, "hls");
+
         // Only log a warning every 60 seconds to avoid log spam
         if (current_time - *last_warning_time > 60 || first_check) {
-            log_warn("[Stream %s] HLS writer is not recording, attempting to restart...", thread->stream_name);
+            log_warn("[Stream %s] HLS writer is not recording", thread->stream_name);
             *last_warning_time = current_time;
 
-            // Try to restart the HLS writer if it's not recording
-            stream_config_t config;
-            if (get_stream_config(stream, &config) == 0) {
-                // Stop and restart the HLS stream
-                if (config.url[0] != '\0') {
-                    log_info("[Stream %s] Attempting to restart HLS stream with URL: %s",
-                            thread->stream_name, config.url);
-
-                    // CRITICAL FIX: Check if the stream is already in the process of being stopped
-                    stream_state_manager_t *state = get_stream_state_by_name(thread->stream_name);
-                    if (state && is_stream_state_stopping(state)) {
-                        log_warn("[Stream %s] Stream is already in the process of being stopped, waiting before restart", thread->stream_name);
-                        // Wait longer to ensure the stream is fully stopped
-                        usleep(2000000); // 2 seconds
-                    }
-
-                    // Stop the HLS stream
-                    stop_hls_stream(thread->stream_name);
-
-                    // CRITICAL FIX: Wait longer to ensure the stream thread has fully exited
-                    // This prevents use-after-free issues when restarting the stream
-                    usleep(2000000); // 2 seconds
-
-                    // CRITICAL FIX: Verify the stream is not in the stopping state before restarting
-                    state = get_stream_state_by_name(thread->stream_name);
-                    if (state && is_stream_state_stopping(state)) {
-                        log_warn("[Stream %s] Stream is still in stopping state, waiting longer", thread->stream_name);
-                        usleep(3000000); // 3 more seconds
-                    }
-
-                    // Restart the HLS stream
-                    log_info("[Stream %s] Starting HLS stream after proper shutdown", thread->stream_name);
-                    start_hls_stream(thread->stream_name);
-                }
+            // Nothing runs to be restarted
+            if (!supervised) {
+                log_info("[Stream %s] Starting HLS stream for detection", thread->stream_name);
+                start_hls_stream(thread->stream_name);
             }
         }
     } else {
@@ -204,6 +280,18 @@ bool find_hls_directory(stream_detection_thread_t *thread, time_t current_time,
     strncpy(stream_name_copy, thread->stream_name, MAX_STREAM_NAME - 1);
     stream_name_copy[MAX_STREAM_NAME - 1] = '\0';
 
+    // The HLS writer of this stream knows where it writes, so skip probing the filesystem
+    char indexed_dir[MAX_PATH_LENGTH];
+    if (hls_segment_index_get_directory(thread->stream_name, indexed_dir, sizeof(indexed_dir)) == 0) {
+        if (strcmp(thread->hls_dir, indexed_dir) != 0) {
+            strncpy(thread->hls_dir, indexed_dir, MAX_PATH_LENGTH - 1);
+            thread->hls_dir[MAX_PATH_LENGTH - 1] = '\0';
+            log_info("[Stream %s] Using HLS directory of the HLS writer: %s", thread->stream_name, thread->hls_dir);
+        }
+        *consecutive_failures = 0;
+        return true;
+    }
+
     // Get the HLS directory for this stream using the global config
     char hls_dir[MAX_PATH_LENGTH];
 
@@ -395,6 +483,18 @@ bool find_newest_segment(stream_detection_thread_t *thread, char *newest_segment
     *newest_time = 0;
     newest_segment[0] = '\0';
 
+    // Segments written by our HLS writer are indexed as they complete
+    if (hls_segment_index_is_active(thread->stream_name)) {
+        hls_segment_info_t latest;
+        if (hls_segment_index_get_latest(thread->stream_name, &latest, segment_count) != 0) {
+            return false;
+        }
+        strncpy(newest_segment, latest.path, MAX_PATH_LENGTH - 1);
+        newest_segment[MAX_PATH_LENGTH - 1] = '\0';
+        *newest_time = latest.completed_time;
+        return true;
+    }
+
     dir = opendir(thread->hls_dir);
     if (!dir) {
         log_error("[Stream %s] Failed to open HLS directory: %s (error: %s)",
@@ -481,101 +581,21 @@ void restart_hls_stream_if_needed(stream_detection_thread_t *thread, time_t curr
     strncpy(stream_name_copy, thread->stream_name, MAX_STREAM_NAME - 1);
     stream_name_copy[MAX_STREAM_NAME - 1] = '\0';
 
+    // Restarting is up to the supervisor, which backs off if restarts do not help
+    bool supervised = true;
+    if (!is_hls_stream_active(thread->stream_name)) {
+        supervised = supervisor_report_stall(thread->stream_name, "hls");
+    }
+
     // Only log a warning every 60 seconds to avoid log spam
     if (current_time - *last_warning_time > 60 || first_check) {
         log_warn("[Stream %s] No segments found in directory: %s", stream_name_copy, thread->hls_dir);
         *last_warning_time = current_time;
 
-        // Check if the HLS writer is recording
-        stream_handle_t stream = get_stream_by_name(thread->stream_name);
-        if (stream) {
-            // CRITICAL FIX: Add safety checks to prevent segfault when accessing HLS writer
-            hls_writer_t *writer = NULL;
-
-            // Use a try/catch-like approach to prevent segfaults
-            bool writer_access_failed = false;
-
-            // Safely try to get the HLS writer
-            __attribute__((unused)) volatile int writer_check_result = 0;
-            writer = get_stream_hls_writer(stream);
-
-            // Check if we got a valid writer
-            if (writer) {
-                bool is_recording = is_hls_stream_active(thread->stream_name);
-                log_info("[Stream %s] HLS writer recording status: %s",
-                        thread->stream_name, is_recording ? "RECORDING" : "NOT RECORDING");
-
-                if (!is_recording) {
-                    // Try to restart the HLS writer
-                    stream_config_t config;
-                    if (get_stream_config(stream, &config) == 0 && config.url[0] != '\0') {
-                        log_info("[Stream %s] Attempting to restart HLS writer with URL: %s",
-                                thread->stream_name, config.url);
-
-                        // CRITICAL FIX: Add additional safety checks before stopping/starting HLS stream
-                        log_info("[Stream %s] Attempting to restart HLS stream", thread->stream_name);
-
-                        // CRITICAL FIX: Check if the stream is already in the process of being stopped
-                        stream_state_manager_t *state = get_stream_state_by_name(thread->stream_name);
-                        if (state && is_stream_state_stopping(state)) {
-                            log_warn("[Stream %s] Stream is already in the process of being stopped, waiting before restart", thread->stream_name);
-                            // Wait longer to ensure the stream is fully stopped
-                            usleep(2000000); // 2 seconds
-                        }
-
-                        // Safely stop the HLS stream
-                        stop_hls_stream(thread->stream_name);
-
-                        // CRITICAL FIX: Wait longer to ensure the stream thread has fully exited
-                        // This prevents use-after-free issues when restarting the stream
-                        usleep(2000000); // 2 seconds
-
-                        // CRITICAL FIX: Verify the stream is not in the stopping state before restarting
-                        state = get_stream_state_by_name(thread->stream_name);
-                        if (state && is_stream_state_stopping(state)) {
-                            log_warn("[Stream %s] Stream is still in stopping state, waiting longer", thread->stream_name);
-                            usleep(3000000); // 3 more seconds
-                        }
-
-                        // Restart the HLS stream
-                        log_info("[Stream %s] Starting HLS stream after proper shutdown", thread->stream_name);
-                        start_hls_stream(thread->stream_name);
-                        log_info("[Stream %s] HLS stream restart attempted", thread->stream_name);
-                    }
-                }
-            } else {
-                // Writer is NULL, log the issue
-                log_warn("[Stream %s] HLS writer is NULL, cannot check recording status", thread->stream_name);
-
-                // Try to restart the stream anyway
-                log_info("[Stream %s] Attempting to restart HLS stream despite NULL writer", thread->stream_name);
-
-                // CRITICAL FIX: Check if the stream is already in the process of being stopped
-                stream_state_manager_t *state = get_stream_state_by_name(thread->stream_name);
-                if (state && is_stream_state_stopping(state)) {
-                    log_warn("[Stream %s] Stream is already in the process of being stopped, waiting before restart", thread->stream_name);
-                    // Wait longer to ensure the stream is fully stopped
-                    usleep(2000000); // 2 seconds
-                }
-
-                // Safely stop the HLS stream
-                stop_hls_stream(thread->stream_name);
-
-                // CRITICAL FIX: Wait longer to ensure the stream thread has fully exited
-                // This prevents use-after-free issues when restarting the stream
-                usleep(2000000); // 2 seconds
-
-                // CRITICAL FIX: Verify the stream is not in the stopping state before restarting
-                state = get_stream_state_by_name(thread->stream_name);
-                if (state && is_stream_state_stopping(state)) {
-                    log_warn("[Stream %s] Stream is still in stopping state, waiting longer", thread->stream_name);
-                    usleep(3000000); // 3 more seconds
-                }
-
-                // Restart the HLS stream
-                log_info("[Stream %s] Starting HLS stream after proper shutdown", thread->stream_name);
-                start_hls_stream(thread->stream_name);
-            }
+        // Nothing runs to be restarted
+        if (!supervised) {
+            log_info("[Stream %s] Starting HLS stream for detection", stream_name_copy);
+            start_hls_stream(thread->stream_name);
         }
     }
 }
@@ -820,34 +840,16 @@ int process_segment_if_needed(stream_detection_thread_t *thread,
                             if (result_struct.count > 0) {
                                 log_info("[Stream %s] ONVIF detection found motion", thread->stream_name);
 
-                                // Create a dummy frame buffer for recording
-                                // We don't have actual frame data for ONVIF, but we need to pass something
-                                // to process_frame_for_recording
-                                int width = 640;  // Default width
-                                int height = 480; // Default height
-                                int channels = 3; // RGB
-                                uint8_t *dummy_frame = (uint8_t *)calloc(width * height * channels, 1);
-
-                                if (dummy_frame) {
-                                    // Process the detection results for recording
-                                    time_t current_time = time(NULL);
-                                    int record_ret = process_frame_for_recording(thread->stream_name,
-                                                                              dummy_frame, width, height,
-                                                                              channels, current_time, &result_struct);
-
-                                    if (record_ret != 0) {
-                                        log_error("[Stream %s] Failed to process ONVIF detection for recording (error code: %d)",
-                                                 thread->stream_name, record_ret);
-                                    } else {
-                                        log_info("[Stream %s] Successfully processed ONVIF detection for recording",
-                                                thread->stream_name);
-                                    }
-
-                                    free(dummy_frame);
-                                } else {
-                                    log_error("[Stream %s] Failed to allocate dummy frame for ONVIF recording",
-                                             thread->stream_name);
-                                }
+                                // Detection-based recording picks the motion up from the event bus
+                                bus_event_t event = {
+                                    .type = BUS_EVENT_ONVIF_MOTION,
+                                    .time = time(NULL),
+                                    .pts = -1,
+                                    .threshold = thread->threshold,
+                                    .result = result_struct,
+                                };
+                                snprintf(event.stream_name, sizeof(event.stream_name), "%s", thread->stream_name);
+                                event_bus_publish(&event);
                             } else {
                                 log_info("[Stream %s] No motion detected in ONVIF detection", thread->stream_name);
                             }
@@ -0,0 +1,159 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "video/detection_zones.h"
+
+/**
+ * Parse one "x,y" vertex
+ * @return Pointer past the vertex, or NULL if it is invalid
+ */
+static const char *parse_point(const char *p, float *x, float *y) {
+    char *end;
+    *x = strtof(p, &end);
+    if (end == p || *end != ',') {
+        return NULL;
+    }
+    p = end + 1;
+    *y = strtof(p, &end);
+    if (end == p || *x < 0.0f || *x > 1.0f || *y < 0.0f || *y > 1.0f) {
+        return NULL;
+    }
+    return end;
+}
+
+int parse_detection_zones(const char *text, detection_zone_t *zones, int max_zones) {
+    if (!text || !zones) {
+        return 0;
+    }
+
+    int count = 0;
+    const char *p = text;
+    while (*p) {
+        while (isspace((unsigned char)*p) || *p == '|') {
+            p++;
+        }
+        if (!*p) {
+            break;
+        }
+        if (count >= max_zones) {
+            return -1;
+        }
+
+        detection_zone_t *zone = &zones[count];
+        zone->point_count = 0;
+        while (*p && *p != '|') {
+            if (zone->point_count >= MAX_ZONE_POINTS) {
+                return -1;
+            }
+            p = parse_point(p, &zone->x[zone->point_count], &zone->y[zone->point_count]);
+            if (!p) {
+                return -1;
+            }
+            zone->point_count++;
+            while (isspace((unsigned char)*p)) {
+                p++;
+            }
+        }
+
+        if (zone->point_count == 2) {
+            // Opposite corners of a rectangle
+            float x0 = zone->x[0], y0 = zone->y[0];
+            float x1 = zone->x[1], y1 = zone->y[1];
+            zone->x[1] = x1; zone->y[1] = y0;
+            zone->x[2] = x1; zone->y[2] = y1;
+            zone->x[3] = x0; zone->y[3] = y1;
+            zone->point_count = 4;
+        } else if (zone->point_count < 3) {
+            return -1;
+        }
+        count++;
+    }
+    return count;
+}
+
+int format_detection_zones(const detection_zone_t *zones, int count, char *text, size_t size) {
+    if (!text || size == 0) {
+        return -1;
+    }
+
+    size_t len = 0;
+    text[0] = '\0';
+    for (int i = 0; i < count; i++) {
+        for (int j = 0; j < zones[i].point_count; j++) {
+            const char *sep = j > 0 ? " " : (i > 0 ? " | " : "");
+            int n = snprintf(text + len, size - len, "%s%.4g,%.4g", sep, zones[i].x[j], zones[i].y[j]);
+            if (n < 0 || (size_t)n >= size - len) {
+                text[0] = '\0';
+                return -1;
+            }
+            len += (size_t)n;
+        }
+    }
+    return 0;
+}
+
+bool detection_zones_bounds(const detection_zone_t *zones, int count, detection_t *bounds) {
+    if (count <= 0) {
+        return false;
+    }
+
+    float x0 = 1.0f, y0 = 1.0f, x1 = 0.0f, y1 = 0.0f;
+    for (int i = 0; i < count; i++) {
+        for (int j = 0; j < zones[i].point_count; j++) {
+            if (zones[i].x[j] < x0) x0 = zones[i].x[j];
+            if (zones[i].x[j] > x1) x1 = zones[i].x[j];
+            if (zones[i].y[j] < y0) y0 = zones[i].y[j];
+            if (zones[i].y[j] > y1) y1 = zones[i].y[j];
+        }
+    }
+
+    bounds->x = x0;
+    bounds->y = y0;
+    bounds->width = x1 - x0;
+    bounds->height = y1 - y0;
+    return true;
+}
+
+/**
+ * Even-odd test of a point against a polygon
+ */
+static bool zone_contains(const detection_zone_t *zone, float x, float y) {
+    bool inside = false;
+    for (int i = 0, j = zone->point_count - 1; i < zone->point_count; j = i++) {
+        if ((zone->y[i] > y) != (zone->y[j] > y) &&
+            x < zone->x[j] + (zone->x[i] - zone->x[j]) * (y - zone->y[j]) / (zone->y[i] - zone->y[j])) {
+            inside = !inside;
+        }
+    }
+    return inside;
+}
+
+int filter_detections_by_zones(const detection_zone_t *zones, int count, detection_result_t *result) {
+    if (count <= 0 || !result) {
+        return 0;
+    }
+
+    int kept = 0;
+    for (int i = 0; i < result->count && i < MAX_DETECTIONS; i++) {
+        const detection_t *det = &result->detections[i];
+        float foot_x = det->x + det->width / 2.0f;
+        // Just inside the box, so a zone edge level with the box bottom still counts
+        float foot_y = det->y + det->height * 0.98f;
+
+        for (int z = 0; z < count; z++) {
+            if (zone_contains(&zones[z], foot_x, foot_y)) {
+                if (kept != i) {
+                    result->detections[kept] = *det;
+                }
+                kept++;
+                break;
+            }
+        }
+    }
+
+    int dropped = result->count - kept;
+    result->count = kept;
+    return dropped;
+}
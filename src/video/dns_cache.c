@@ -0,0 +1,402 @@
+/**
+ * Camera host name cache
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <strings.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+
+#include "core/config.h"
+#include "core/logger.h"
+#include "video/dns_cache.h"
+#include "video/reconnect_manager.h"
+#include "video/thread_utils.h"
+
+// Hosts cached at once, cameras and their ONVIF endpoints
+#define DNS_CACHE_MAX_HOSTS (MAX_STREAMS * 2)
+
+// A resolved address is refreshed after this long
+#define DNS_CACHE_TTL_MS 300000
+
+// A failed resolution is retried after this long; until then lookups of a
+// host that never resolved fail without asking the DNS server again
+#define DNS_CACHE_RETRY_MS 30000
+
+// Hosts not looked up for this long are dropped
+#define DNS_CACHE_IDLE_MS 3600000
+
+// How often the refresh thread looks for stale entries
+#define DNS_CACHE_TICK_MS 5000
+
+// Longest a lookup waits for another thread resolving the same host
+#define DNS_CACHE_WAIT_MS 10000
+
+typedef struct {
+    bool used;
+    char host[256];
+    char addr[INET6_ADDRSTRLEN];
+    bool has_addr;
+    bool resolving;             // Being resolved without the lock
+    int64_t refresh_ms;         // When the entry is resolved again
+    int64_t last_used_ms;
+} dns_entry_t;
+
+static struct {
+    pthread_t thread;
+    bool running;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;        // Signaled on stop and when a resolution finishes
+    dns_entry_t entries[DNS_CACHE_MAX_HOSTS];
+} cache = {
+    .running = false,
+    .mutex = PTHREAD_MUTEX_INITIALIZER
+};
+
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+
+static void init_cond(void) {
+    pthread_condattr_t cond_attr;
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&cache.cond, &cond_attr);
+    pthread_condattr_destroy(&cond_attr);
+}
+
+static int64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static bool is_numeric_host(const char *host) {
+    unsigned char buf[sizeof(struct in6_addr)];
+    return inet_pton(AF_INET, host, buf) == 1 || inet_pton(AF_INET6, host, buf) == 1;
+}
+
+/**
+ * Resolve a host name, preferring an IPv4 address
+ * Runs without the cache mutex.
+ */
+static bool resolve_host(const char *host, char *addr, size_t size) {
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    struct addrinfo *addrs = NULL;
+    if (getaddrinfo(host, NULL, &hints, &addrs) != 0 || !addrs) {
+        return false;
+    }
+
+    struct addrinfo *chosen = addrs;
+    for (struct addrinfo *ai = addrs; ai; ai = ai->ai_next) {
+        if (ai->ai_family == AF_INET) {
+            chosen = ai;
+            break;
+        }
+    }
+
+    const void *src;
+    if (chosen->ai_family == AF_INET) {
+        src = &((struct sockaddr_in *)chosen->ai_addr)->sin_addr;
+    } else {
+        src = &((struct sockaddr_in6 *)chosen->ai_addr)->sin6_addr;
+    }
+    bool ok = inet_ntop(chosen->ai_family, src, addr, (socklen_t)size) != NULL;
+
+    freeaddrinfo(addrs);
+    return ok;
+}
+
+/**
+ * Find the entry of a host, adding it if it has none
+ * Must be called with the cache mutex held.
+ */
+static dns_entry_t *get_entry(const char *host, int64_t now) {
+    dns_entry_t *free_entry = NULL;
+    dns_entry_t *oldest = NULL;
+
+    for (int i = 0; i < DNS_CACHE_MAX_HOSTS; i++) {
+        dns_entry_t *entry = &cache.entries[i];
+        if (!entry->used) {
+            if (!free_entry) {
+                free_entry = entry;
+            }
+            continue;
+        }
+        if (strcmp(entry->host, host) == 0) {
+            entry->last_used_ms = now;
+            return entry;
+        }
+        if (!entry->resolving && (!oldest || entry->last_used_ms < oldest->last_used_ms)) {
+            oldest = entry;
+        }
+    }
+
+    dns_entry_t *entry = free_entry ? free_entry : oldest;
+    if (!entry) {
+        return NULL;
+    }
+
+    memset(entry, 0, sizeof(*entry));
+    entry->used = true;
+    snprintf(entry->host, sizeof(entry->host), "%s", host);
+    entry->last_used_ms = now;
+    return entry;
+}
+
+/**
+ * Resolve an entry again
+ * Must be called with the cache mutex held; it is released while resolving.
+ */
+static void refresh_entry(dns_entry_t *entry) {
+    char host[256];
+    char addr[INET6_ADDRSTRLEN];
+    snprintf(host, sizeof(host), "%s", entry->host);
+
+    entry->resolving = true;
+    pthread_mutex_unlock(&cache.mutex);
+
+    bool ok = resolve_host(host, addr, sizeof(addr));
+
+    pthread_mutex_lock(&cache.mutex);
+    int64_t now = now_ms();
+    entry->resolving = false;
+    // The entry is not reused while resolving, so it is still this host
+    if (ok) {
+        if (entry->has_addr && strcmp(entry->addr, addr) != 0) {
+            log_info("Camera host %s moved from %s to %s", host, entry->addr, addr);
+        }
+        snprintf(entry->addr, sizeof(entry->addr), "%s", addr);
+        entry->has_addr = true;
+        entry->refresh_ms = now + DNS_CACHE_TTL_MS;
+    } else {
+        if (entry->has_addr) {
+            log_warn("Failed to resolve camera host %s, keeping address %s", host, entry->addr);
+        } else {
+            log_warn("Failed to resolve camera host %s", host);
+        }
+        entry->refresh_ms = now + DNS_CACHE_RETRY_MS;
+    }
+    pthread_cond_broadcast(&cache.cond);
+}
+
+/**
+ * Refresh thread: resolves stale entries ahead of the lookups needing them
+ */
+static void *dns_cache_thread(void *arg) {
+    (void)arg;
+    thread_set_identity(THREAD_CLASS_SERVICE, "dns-cache", NULL);
+
+    pthread_mutex_lock(&cache.mutex);
+    while (cache.running) {
+        int64_t now = now_ms();
+        for (int i = 0; i < DNS_CACHE_MAX_HOSTS && cache.running; i++) {
+            dns_entry_t *entry = &cache.entries[i];
+            if (!entry->used || entry->resolving) {
+                continue;
+            }
+            if (now - entry->last_used_ms > DNS_CACHE_IDLE_MS) {
+                entry->used = false;
+                continue;
+            }
+            if (now >= entry->refresh_ms) {
+                refresh_entry(entry);
+                now = now_ms();
+            }
+        }
+
+        if (!cache.running) {
+            break;
+        }
+        int64_t wake = now_ms() + DNS_CACHE_TICK_MS;
+        struct timespec ts = {
+            .tv_sec = wake / 1000,
+            .tv_nsec = (wake % 1000) * 1000000
+        };
+        pthread_cond_timedwait(&cache.cond, &cache.mutex, &ts);
+    }
+    pthread_mutex_unlock(&cache.mutex);
+
+    return NULL;
+}
+
+int dns_cache_start(void) {
+    pthread_once(&init_once, init_cond);
+
+    pthread_mutex_lock(&cache.mutex);
+    if (cache.running) {
+        pthread_mutex_unlock(&cache.mutex);
+        return 0;
+    }
+
+    cache.running = true;
+    if (pthread_create(&cache.thread, NULL, dns_cache_thread, NULL) != 0) {
+        log_error("Failed to start DNS cache thread");
+        cache.running = false;
+        pthread_mutex_unlock(&cache.mutex);
+        return -1;
+    }
+    pthread_mutex_unlock(&cache.mutex);
+
+    log_info("DNS cache started");
+    return 0;
+}
+
+void dns_cache_stop(void) {
+    pthread_mutex_lock(&cache.mutex);
+    if (!cache.running) {
+        pthread_mutex_unlock(&cache.mutex);
+        return;
+    }
+    cache.running = false;
+    pthread_cond_broadcast(&cache.cond);
+    pthread_mutex_unlock(&cache.mutex);
+
+    pthread_join(cache.thread, NULL);
+    log_info("DNS cache stopped");
+}
+
+int dns_cache_lookup(const char *host, char *addr, size_t size) {
+    if (!host || !*host || !addr || size == 0) {
+        return -1;
+    }
+
+    if (is_numeric_host(host)) {
+        snprintf(addr, size, "%s", host);
+        return 0;
+    }
+
+    pthread_once(&init_once, init_cond);
+    pthread_mutex_lock(&cache.mutex);
+
+    int64_t now = now_ms();
+    dns_entry_t *entry = get_entry(host, now);
+    if (!entry) {
+        pthread_mutex_unlock(&cache.mutex);
+        char resolved[INET6_ADDRSTRLEN];
+        if (!resolve_host(host, resolved, sizeof(resolved))) {
+            return -1;
+        }
+        snprintf(addr, size, "%s", resolved);
+        return 0;
+    }
+
+    if (entry->resolving && !entry->has_addr) {
+        // Another thread is resolving the host for the first time
+        int64_t wake = now + DNS_CACHE_WAIT_MS;
+        struct timespec ts = {
+            .tv_sec = wake / 1000,
+            .tv_nsec = (wake % 1000) * 1000000
+        };
+        while (entry->resolving) {
+            if (pthread_cond_timedwait(&cache.cond, &cache.mutex, &ts) == ETIMEDOUT) {
+                break;
+            }
+        }
+    } else if (!entry->resolving && now >= entry->refresh_ms && (!entry->has_addr || !cache.running)) {
+        // First lookup, or a stale entry with no thread to refresh it
+        refresh_entry(entry);
+    }
+
+    int result = -1;
+    if (entry->has_addr) {
+        snprintf(addr, size, "%s", entry->addr);
+        result = 0;
+    }
+
+    pthread_mutex_unlock(&cache.mutex);
+    return result;
+}
+
+/**
+ * Find where the host of a URL starts, after any user:password@
+ */
+static const char *url_host_start(const char *url) {
+    const char *sep = strstr(url, "://");
+    if (!sep) {
+        return NULL;
+    }
+
+    const char *start = sep + 3;
+    const char *end = start + strcspn(start, "/?#");
+    for (const char *p = end; p > start; p--) {
+        if (p[-1] == '@') {
+            return p;
+        }
+    }
+    return start;
+}
+
+int dns_cache_resolve_url(const char *url, char *out, size_t size) {
+    static const char *plain_schemes[] = {"rtsp://", "rtmp://", "http://"};
+
+    if (!url || !out || size == 0) {
+        return -1;
+    }
+    snprintf(out, size, "%s", url);
+
+    bool plain = false;
+    for (size_t i = 0; i < sizeof(plain_schemes) / sizeof(plain_schemes[0]); i++) {
+        if (strncasecmp(url, plain_schemes[i], strlen(plain_schemes[i])) == 0) {
+            plain = true;
+            break;
+        }
+    }
+    if (!plain) {
+        return -1;
+    }
+
+    char host[256];
+    int port;
+    if (reconnect_manager_host(url, host, sizeof(host), &port) != 0 || is_numeric_host(host)) {
+        return -1;
+    }
+
+    const char *start = url_host_start(url);
+    size_t host_len = strlen(host);
+    if (!start || strncmp(start, host, host_len) != 0) {
+        return -1;
+    }
+
+    char addr[INET6_ADDRSTRLEN];
+    if (dns_cache_lookup(host, addr, sizeof(addr)) != 0) {
+        return -1;
+    }
+
+    bool v6 = strchr(addr, ':') != NULL;
+    int n = snprintf(out, size, "%.*s%s%s%s%s", (int)(start - url), url,
+                     v6 ? "[" : "", addr, v6 ? "]" : "", start + host_len);
+    if (n < 0 || (size_t)n >= size) {
+        snprintf(out, size, "%s", url);
+        return -1;
+    }
+    return 0;
+}
+
+int dns_cache_curl_entry(const char *url, char *entry, size_t size) {
+    char host[256];
+    int port;
+    if (!entry || size == 0 || reconnect_manager_host(url, host, sizeof(host), &port) != 0 ||
+        is_numeric_host(host)) {
+        return -1;
+    }
+
+    char addr[INET6_ADDRSTRLEN];
+    if (dns_cache_lookup(host, addr, sizeof(addr)) != 0) {
+        return -1;
+    }
+
+    bool v6 = strchr(addr, ':') != NULL;
+    int n = snprintf(entry, size, "%s:%d:%s%s%s", host, port, v6 ? "[" : "", addr, v6 ? "]" : "");
+    return (n > 0 && (size_t)n < size) ? 0 : -1;
+}
@@ -1,39 +1,112 @@
+#define _GNU_SOURCE
 #include "video/ffmpeg_leak_detector.h"
 #include "core/logger.h"
+#include "core/metrics.h"
 #include <pthread.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
+// Buckets of the allocation table, a power of two
+#define LEAK_TABLE_SIZE 1024
+
+// Objects of one type a single thread may hold before the check warns;
+// a stream thread keeps one input context for as long as it is connected
+#define LEAK_OWNER_LIMIT 4
+
+// Thread names are at most 15 characters on Linux
+#define LEAK_OWNER_LEN 16
+
+typedef enum {
+    LEAK_TYPE_FORMAT_CTX = 0,
+    LEAK_TYPE_PACKET,
+    LEAK_TYPE_FRAME,
+    LEAK_TYPE_CODEC_CTX,
+    LEAK_TYPE_OTHER,
+    LEAK_TYPE_COUNT
+} leak_type_t;
+
+static const char *type_names[LEAK_TYPE_COUNT] = {
+    "AVFormatContext", "AVPacket", "AVFrame", "AVCodecContext", "other"
+};
+
 // Structure to track FFmpeg allocations
-typedef struct {
+typedef struct ffmpeg_allocation {
     void *ptr;
-    const char *type;
+    leak_type_t type;
     const char *location;
     int line;
+    char owner[LEAK_OWNER_LEN];
+    struct ffmpeg_allocation *next;
 } ffmpeg_allocation_t;
 
-// Array to store tracked allocations
-static ffmpeg_allocation_t *tracked_allocations = NULL;
+typedef struct {
+    uint64_t live;
+    uint64_t opened;
+    uint64_t closed;
+} leak_type_stats_t;
+
+static ffmpeg_allocation_t *table[LEAK_TABLE_SIZE];
+static leak_type_stats_t type_stats[LEAK_TYPE_COUNT];
 static int allocation_count = 0;
-static int allocation_capacity = 0;
 static pthread_mutex_t allocation_mutex = PTHREAD_MUTEX_INITIALIZER;
 
-// Initialize the leak detector
-void ffmpeg_leak_detector_init(void) {
-    pthread_mutex_lock(&allocation_mutex);
+static metric_t live_metrics[LEAK_TYPE_COUNT];
+static metric_t opened_metrics[LEAK_TYPE_COUNT];
+static metric_t closed_metrics[LEAK_TYPE_COUNT];
+static uint64_t reported_opened[LEAK_TYPE_COUNT];
+static uint64_t reported_closed[LEAK_TYPE_COUNT];
 
-    // Initialize with capacity for 1000 allocations
-    allocation_capacity = 1000;
-    tracked_allocations = calloc(allocation_capacity, sizeof(ffmpeg_allocation_t));
+static unsigned int bucket_of(const void *ptr) {
+    uintptr_t p = (uintptr_t)ptr;
+    // Allocations are aligned, so the low bits carry no information
+    p ^= p >> 17;
+    return (unsigned int)((p >> 4) * 2654435761u) & (LEAK_TABLE_SIZE - 1);
+}
 
-    if (!tracked_allocations) {
-        log_error("Failed to initialize FFmpeg leak detector");
-        allocation_capacity = 0;
-    } else {
-        log_info("FFmpeg leak detector initialized with capacity for %d allocations", allocation_capacity);
+static leak_type_t type_of(const char *type) {
+    for (int i = 0; i < LEAK_TYPE_OTHER; i++) {
+        if (strcmp(type, type_names[i]) == 0) {
+            return (leak_type_t)i;
+        }
     }
+    return LEAK_TYPE_OTHER;
+}
 
+// Refresh the gauges and counters before a scrape
+static void collect_ffmpeg_metrics(void) {
+    leak_type_stats_t stats[LEAK_TYPE_COUNT];
+
+    pthread_mutex_lock(&allocation_mutex);
+    memcpy(stats, type_stats, sizeof(stats));
     pthread_mutex_unlock(&allocation_mutex);
+
+    // Only the collector adds to the counters, so deltas cannot be lost
+    for (int i = 0; i < LEAK_TYPE_COUNT; i++) {
+        metrics_set(live_metrics[i], stats[i].live);
+        metrics_add(opened_metrics[i], stats[i].opened - reported_opened[i]);
+        metrics_add(closed_metrics[i], stats[i].closed - reported_closed[i]);
+        reported_opened[i] = stats[i].opened;
+        reported_closed[i] = stats[i].closed;
+    }
+}
+
+// Initialize the leak detector
+void ffmpeg_leak_detector_init(void) {
+    for (int i = 0; i < LEAK_TYPE_COUNT; i++) {
+        live_metrics[i] = metrics_gauge("lightnvr_ffmpeg_objects",
+                                        "FFmpeg objects currently open by type",
+                                        "type", type_names[i], NULL);
+        opened_metrics[i] = metrics_counter("lightnvr_ffmpeg_objects_opened_total",
+                                            "FFmpeg objects opened by type",
+                                            "type", type_names[i], NULL);
+        closed_metrics[i] = metrics_counter("lightnvr_ffmpeg_objects_closed_total",
+                                            "FFmpeg objects closed by type",
+                                            "type", type_names[i], NULL);
+    }
+    metrics_add_collector(collect_ffmpeg_metrics);
+
+    log_info("FFmpeg leak detector initialized");
 }
 
 // Clean up the leak detector
@@ -43,23 +116,28 @@ void ffmpeg_leak_detector_cleanup(void) {
     // Report any leaks
     if (allocation_count > 0) {
         log_warn("FFmpeg leak detector found %d potential leaks:", allocation_count);
-        for (int i = 0; i < allocation_count; i++) {
-            log_warn("  Leak %d: %s at %p (from %s:%d)",
-                    i + 1,
-                    tracked_allocations[i].type,
-                    tracked_allocations[i].ptr,
-                    tracked_allocations[i].location,
-                    tracked_allocations[i].line);
-        }
     } else {
         log_info("FFmpeg leak detector found no leaks");
     }
 
-    // Free the allocation tracker
-    free(tracked_allocations);
-    tracked_allocations = NULL;
+    int n = 0;
+    for (int b = 0; b < LEAK_TABLE_SIZE; b++) {
+        ffmpeg_allocation_t *entry = table[b];
+        while (entry) {
+            ffmpeg_allocation_t *next = entry->next;
+            log_warn("  Leak %d: %s at %p owned by %s (from %s:%d)",
+                    ++n, type_names[entry->type], entry->ptr, entry->owner,
+                    entry->location, entry->line);
+            free(entry);
+            entry = next;
+        }
+        table[b] = NULL;
+    }
+
     allocation_count = 0;
-    allocation_capacity = 0;
+    for (int i = 0; i < LEAK_TYPE_COUNT; i++) {
+        type_stats[i].live = 0;
+    }
 
     pthread_mutex_unlock(&allocation_mutex);
 }
@@ -68,34 +146,29 @@ void ffmpeg_leak_detector_cleanup(void) {
 void ffmpeg_track_allocation(void *ptr, const char *type, const char *location, int line) {
     if (!ptr) return;
 
-    pthread_mutex_lock(&allocation_mutex);
-
-    // Check if we need to expand the array
-    if (allocation_count >= allocation_capacity && tracked_allocations) {
-        int new_capacity = allocation_capacity * 2;
-        ffmpeg_allocation_t *new_array = realloc(tracked_allocations,
-                                                new_capacity * sizeof(ffmpeg_allocation_t));
-
-        if (new_array) {
-            tracked_allocations = new_array;
-            allocation_capacity = new_capacity;
-            log_debug("FFmpeg leak detector expanded to capacity %d", allocation_capacity);
-        } else {
-            log_error("Failed to expand FFmpeg leak detector capacity");
-            pthread_mutex_unlock(&allocation_mutex);
-            return;
-        }
+    ffmpeg_allocation_t *entry = calloc(1, sizeof(ffmpeg_allocation_t));
+    if (!entry) {
+        log_error("Failed to track FFmpeg allocation %p", ptr);
+        return;
     }
 
-    // Add the allocation to the array
-    if (tracked_allocations && allocation_count < allocation_capacity) {
-        tracked_allocations[allocation_count].ptr = ptr;
-        tracked_allocations[allocation_count].type = type;
-        tracked_allocations[allocation_count].location = location;
-        tracked_allocations[allocation_count].line = line;
-        allocation_count++;
+    entry->ptr = ptr;
+    entry->type = type_of(type);
+    entry->location = location;
+    entry->line = line;
+    if (pthread_getname_np(pthread_self(), entry->owner, sizeof(entry->owner)) != 0 ||
+        entry->owner[0] == '\0') {
+        strcpy(entry->owner, "unknown");
     }
 
+    unsigned int b = bucket_of(ptr);
+
+    pthread_mutex_lock(&allocation_mutex);
+    entry->next = table[b];
+    table[b] = entry;
+    allocation_count++;
+    type_stats[entry->type].live++;
+    type_stats[entry->type].opened++;
     pthread_mutex_unlock(&allocation_mutex);
 }
 
@@ -103,23 +176,27 @@ void ffmpeg_track_allocation(void *ptr, const char *type, const char *location,
 void ffmpeg_untrack_allocation(void *ptr) {
     if (!ptr) return;
 
+    unsigned int b = bucket_of(ptr);
+    ffmpeg_allocation_t *found = NULL;
+
     pthread_mutex_lock(&allocation_mutex);
 
-    // Find the allocation in the array
-    for (int i = 0; i < allocation_count; i++) {
-        if (tracked_allocations[i].ptr == ptr) {
-            // Remove it by shifting all subsequent elements
-            if (i < allocation_count - 1) {
-                memmove(&tracked_allocations[i],
-                        &tracked_allocations[i + 1],
-                        (allocation_count - i - 1) * sizeof(ffmpeg_allocation_t));
-            }
+    // Objects closed through the shared helpers were not all tracked, so a
+    // miss is normal and not an error
+    for (ffmpeg_allocation_t **link = &table[b]; *link; link = &(*link)->next) {
+        if ((*link)->ptr == ptr) {
+            found = *link;
+            *link = found->next;
             allocation_count--;
+            type_stats[found->type].live--;
+            type_stats[found->type].closed++;
             break;
         }
     }
 
     pthread_mutex_unlock(&allocation_mutex);
+
+    free(found);
 }
 
 // Get the current number of tracked allocations
@@ -135,18 +212,64 @@ void ffmpeg_dump_allocations(void) {
     pthread_mutex_lock(&allocation_mutex);
 
     log_info("FFmpeg allocation dump (%d allocations):", allocation_count);
-    for (int i = 0; i < allocation_count; i++) {
-        log_info("  Allocation %d: %s at %p (from %s:%d)",
-                i + 1,
-                tracked_allocations[i].type,
-                tracked_allocations[i].ptr,
-                tracked_allocations[i].location,
-                tracked_allocations[i].line);
+    int n = 0;
+    for (int b = 0; b < LEAK_TABLE_SIZE; b++) {
+        for (ffmpeg_allocation_t *entry = table[b]; entry; entry = entry->next) {
+            log_info("  Allocation %d: %s at %p owned by %s (from %s:%d)",
+                    ++n, type_names[entry->type], entry->ptr, entry->owner,
+                    entry->location, entry->line);
+        }
     }
 
     pthread_mutex_unlock(&allocation_mutex);
 }
 
+// Warn about threads holding more objects of one type than they should
+int ffmpeg_leak_detector_check(void) {
+    typedef struct {
+        char owner[LEAK_OWNER_LEN];
+        int count[LEAK_TYPE_COUNT];
+    } owner_count_t;
+
+    pthread_mutex_lock(&allocation_mutex);
+
+    int capacity = allocation_count;
+    owner_count_t *owners = capacity > 0 ? calloc(capacity, sizeof(owner_count_t)) : NULL;
+    int owner_count = 0;
+
+    if (owners) {
+        for (int b = 0; b < LEAK_TABLE_SIZE; b++) {
+            for (ffmpeg_allocation_t *entry = table[b]; entry; entry = entry->next) {
+                int i = 0;
+                while (i < owner_count && strcmp(owners[i].owner, entry->owner) != 0) {
+                    i++;
+                }
+                if (i == owner_count) {
+                    memcpy(owners[i].owner, entry->owner, LEAK_OWNER_LEN);
+                    owner_count++;
+                }
+                owners[i].count[entry->type]++;
+            }
+        }
+    }
+
+    pthread_mutex_unlock(&allocation_mutex);
+
+    int suspects = 0;
+    for (int i = 0; i < owner_count; i++) {
+        for (int t = 0; t < LEAK_TYPE_COUNT; t++) {
+            if (owners[i].count[t] > LEAK_OWNER_LIMIT) {
+                log_warn("Potential FFmpeg leak: thread %s holds %d %s objects",
+                         owners[i].owner, owners[i].count[t], type_names[t]);
+                suspects++;
+            }
+        }
+    }
+
+    free(owners);
+    return suspects;
+}
+
 // Force cleanup of all tracked allocations
 void ffmpeg_force_cleanup_all(void) {
     pthread_mutex_lock(&allocation_mutex);
@@ -156,8 +279,20 @@ void ffmpeg_force_cleanup_all(void) {
     if (allocation_count > 0) {
         log_warn("Skipping cleanup of %d FFmpeg allocations to avoid potential crashes", allocation_count);
 
-        // Just clear the tracking array without attempting to free anything
+        // Just clear the tracking table without attempting to free anything
+        for (int b = 0; b < LEAK_TABLE_SIZE; b++) {
+            ffmpeg_allocation_t *entry = table[b];
+            while (entry) {
+                ffmpeg_allocation_t *next = entry->next;
+                free(entry);
+                entry = next;
+            }
+            table[b] = NULL;
+        }
         allocation_count = 0;
+        for (int i = 0; i < LEAK_TYPE_COUNT; i++) {
+            type_stats[i].live = 0;
+        }
     } else {
         log_info("No FFmpeg allocations to clean up");
     }
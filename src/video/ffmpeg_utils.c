@@ -1,7 +1,6 @@
 #include "video/ffmpeg_utils.h"
 #include "core/logger.h"
 #include "video/ffmpeg_leak_detector.h"
-#include "video/stream_protocol.h"
 
 /**
  * Log FFmpeg error
@@ -138,9 +137,6 @@ void safe_avformat_cleanup(AVFormatContext **ctx_ptr) {
 void comprehensive_ffmpeg_cleanup(AVFormatContext **input_ctx, AVCodecContext **codec_ctx, AVPacket **packet, AVFrame **frame) {
     log_debug("Starting comprehensive FFmpeg resource cleanup");
 
-    // MEMORY LEAK FIX: Add additional cleanup for FFmpeg internal resources
-    // This helps prevent memory leaks in FFmpeg's internal structures
-
     // Clean up frame if provided
     if (frame && *frame) {
         AVFrame *frame_to_free = *frame;
@@ -174,154 +170,12 @@ void comprehensive_ffmpeg_cleanup(AVFormatContext **input_ctx, AVCodecContext **
         log_debug("Cleaned up AVCodecContext");
     }
 
-    // Clean up input context with special handling for parsers and internal buffers
+    // Clean up input context. Stream parameters, extradata and parsers are
+    // owned by the context and released by avformat_close_input; touching
+    // them beforehand only loses track of memory FFmpeg would have freed.
     if (input_ctx && *input_ctx) {
-        AVFormatContext *ctx = *input_ctx;
-
-        // MEMORY LEAK FIX: Manually clean up parsers and internal buffers
-        // This addresses the memory leaks in avformat_find_stream_info
-        if (ctx->nb_streams > 0) {
-            for (unsigned int i = 0; i < ctx->nb_streams; i++) {
-                if (ctx->streams[i]) {
-                    // Clean up any codec parameters
-                    if (ctx->streams[i]->codecpar) {
-                        // We don't free codecpar directly as it's managed by the stream
-                        // But we can clear any internal buffers
-                        if (ctx->streams[i]->codecpar->extradata) {
-                            // The extradata is freed by avformat_close_input, but we'll
-                            // clear the pointer to prevent potential use-after-free
-                            ctx->streams[i]->codecpar->extradata = NULL;
-                            ctx->streams[i]->codecpar->extradata_size = 0;
-                        }
-
-                        // CRITICAL FIX: Explicitly clean up any internal allocations made by avcodec_parameters_from_context
-                        // This addresses the memory leak shown in Valgrind
-                        AVCodecParameters *codecpar = ctx->streams[i]->codecpar;
-                        if (codecpar) {
-                            // Reset fields that might contain allocated memory
-                            if (codecpar->extradata) {
-                                codecpar->extradata = NULL;
-                                codecpar->extradata_size = 0;
-                            }
-
-                            // Clear any other fields that might have allocated memory
-                            codecpar->ch_layout.u.mask = 0;
-                            if (codecpar->ch_layout.nb_channels > 0) {
-                                codecpar->ch_layout.nb_channels = 0;
-                            }
-
-                            // ENHANCED FIX: Create a temporary codec context to force cleanup of internal allocations
-                            // This is a workaround for FFmpeg's internal memory management issues
-                            const AVCodec *codec = avcodec_find_decoder(codecpar->codec_id);
-                            if (codec) {
-                                AVCodecContext *temp_ctx = avcodec_alloc_context3(codec);
-                                if (temp_ctx) {
-                                    // Copy parameters to the context
-                                    int ret = avcodec_parameters_to_context(temp_ctx, codecpar);
-                                    if (ret >= 0) {
-                                        // Now copy back to parameters - this will reallocate and clean up any leaks
-                                        avcodec_parameters_from_context(codecpar, temp_ctx);
-                                    }
-                                    // Free the temporary context
-                                    avcodec_free_context(&temp_ctx);
-                                }
-                            }
-
-                            // Zero out the entire structure to ensure no pointers remain
-                            memset(codecpar, 0, sizeof(AVCodecParameters));
-                        }
-                    }
-                }
-            }
-        }
-
-        // Now use our safe cleanup function
         safe_avformat_cleanup(input_ctx);
     }
 
-    // Note: We're not using aggressive memory cleanup techniques here
-    // to avoid potential segmentation faults
-    // Instead, we rely on FFmpeg's own memory management
-
-    log_info("Comprehensive FFmpeg resource cleanup completed");
-}
-
-/**
- * Periodic FFmpeg resource reset
- * This function performs a periodic reset of FFmpeg resources to prevent memory growth
- * It should be called periodically during long-running operations
- *
- * @param input_ctx_ptr Pointer to the AVFormatContext pointer to reset
- * @param url The URL to reopen after reset
- * @param protocol The protocol to use (TCP/UDP)
- * @return 0 on success, negative value on error
- */
-int periodic_ffmpeg_reset(AVFormatContext **input_ctx_ptr, const char *url, int protocol) {
-    if (!input_ctx_ptr || !url) {
-        log_error("Invalid parameters passed to periodic_ffmpeg_reset");
-        return -1;
-    }
-
-    log_info("Performing periodic FFmpeg resource reset for URL: %s", url);
-
-    // Dump current FFmpeg allocations for debugging
-    ffmpeg_dump_allocations();
-
-    // Close the existing context if it exists
-    if (*input_ctx_ptr) {
-        log_debug("Closing existing input context during reset");
-        safe_avformat_cleanup(input_ctx_ptr);
-        // input_ctx_ptr should now be NULL
-    }
-
-    // Force a garbage collection of FFmpeg resources
-    // FFmpeg doesn't have a direct garbage collection function, but we can
-    // try to release some memory by calling av_buffer_default_free on NULL
-    // which is a no-op but might trigger some internal cleanup
-    av_freep(NULL);
-
-    // Open a new input stream
-    AVFormatContext *new_ctx = NULL;
-    AVDictionary *options = NULL;
-
-    // Set protocol-specific options
-    if (protocol == STREAM_PROTOCOL_TCP) {
-        av_dict_set(&options, "rtsp_transport", "tcp", 0);
-    }
-
-    // Set common options for better reliability
-    av_dict_set(&options, "stimeout", "5000000", 0);  // 5 second timeout in microseconds
-    av_dict_set(&options, "reconnect", "1", 0);       // Auto reconnect
-    av_dict_set(&options, "reconnect_streamed", "1", 0);
-    av_dict_set(&options, "reconnect_delay_max", "2", 0); // Max 2 seconds between reconnects
-
-    // Open the input
-    int ret = avformat_open_input(&new_ctx, url, NULL, &options);
-    av_dict_free(&options);
-
-    if (ret < 0) {
-        char error_buf[AV_ERROR_MAX_STRING_SIZE] = {0};
-        av_strerror(ret, error_buf, AV_ERROR_MAX_STRING_SIZE);
-        log_error("Failed to open input during reset: %s", error_buf);
-        return ret;
-    }
-
-    // Find stream info
-    ret = avformat_find_stream_info(new_ctx, NULL);
-    if (ret < 0) {
-        char error_buf[AV_ERROR_MAX_STRING_SIZE] = {0};
-        av_strerror(ret, error_buf, AV_ERROR_MAX_STRING_SIZE);
-        log_error("Failed to find stream info during reset: %s", error_buf);
-        avformat_close_input(&new_ctx);
-        return ret;
-    }
-
-    // Track the new context
-    TRACK_AVFORMAT_CTX(new_ctx);
-
-    // Set the output parameter
-    *input_ctx_ptr = new_ctx;
-
-    log_info("Successfully reset FFmpeg resources");
-    return 0;
+    log_debug("Comprehensive FFmpeg resource cleanup completed");
 }
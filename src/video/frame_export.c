@@ -0,0 +1,328 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include <libavutil/frame.h>
+#include <libswscale/swscale.h>
+
+#include "core/logger.h"
+#include "core/config.h"
+#include "video/frame_export.h"
+
+// Exported stream
+typedef struct {
+    char stream_name[MAX_STREAM_NAME];
+    char shm_name[MAX_STREAM_NAME + 32];
+    int fd;
+    frame_export_header_t *header;     // Mapping of the whole segment
+    size_t map_size;
+    struct SwsContext *sws_ctx;        // Cached for the stream's frame size
+    uint64_t frame_number;
+    pthread_mutex_t mutex;             // Serializes publishing
+    int refs;                          // Publishers using it (exporters mutex)
+    bool closed;                       // Removed from the table, freed by the last publisher
+} frame_exporter_t;
+
+static frame_exporter_t *exporters[MAX_STREAMS];
+static pthread_mutex_t exporters_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Whether [frame_export] streams lists the stream (an empty list means all)
+ */
+static bool stream_exported(const char *stream_name) {
+    if (!g_config.frame_export_enabled) {
+        return false;
+    }
+
+    const char *list = g_config.frame_export_streams;
+    if (list[0] == '\0') {
+        return true;
+    }
+
+    size_t name_len = strlen(stream_name);
+    const char *p = list;
+    while (*p) {
+        while (*p == ' ' || *p == ',') {
+            p++;
+        }
+        const char *end = p;
+        while (*end && *end != ',') {
+            end++;
+        }
+        const char *last = end;
+        while (last > p && last[-1] == ' ') {
+            last--;
+        }
+        if ((size_t)(last - p) == name_len && strncmp(p, stream_name, name_len) == 0) {
+            return true;
+        }
+        p = end;
+    }
+    return false;
+}
+
+static void destroy_exporter(frame_exporter_t *exp) {
+    if (exp->header) {
+        munmap(exp->header, exp->map_size);
+    }
+    if (exp->fd >= 0) {
+        close(exp->fd);
+        shm_unlink(exp->shm_name);
+    }
+    if (exp->sws_ctx) {
+        sws_freeContext(exp->sws_ctx);
+    }
+    pthread_mutex_destroy(&exp->mutex);
+    free(exp);
+}
+
+/**
+ * Create the shared-memory ring of a stream
+ */
+static frame_exporter_t *create_exporter(const char *stream_name) {
+    int max_size = g_config.frame_export_size > 0 ? g_config.frame_export_size : 640;
+    max_size &= ~1;
+    int slots = g_config.frame_export_slots;
+    if (slots < 2) {
+        slots = 2;
+    } else if (slots > FRAME_EXPORT_MAX_SLOTS) {
+        slots = FRAME_EXPORT_MAX_SLOTS;
+    }
+
+    frame_exporter_t *exp = calloc(1, sizeof(frame_exporter_t));
+    if (!exp) {
+        log_error("Frame export: failed to allocate exporter for %s", stream_name);
+        return NULL;
+    }
+    exp->fd = -1;
+    pthread_mutex_init(&exp->mutex, NULL);
+    strncpy(exp->stream_name, stream_name, MAX_STREAM_NAME - 1);
+    exp->stream_name[MAX_STREAM_NAME - 1] = '\0';
+
+    int len = snprintf(exp->shm_name, sizeof(exp->shm_name), "/lightnvr-frames-%s", stream_name);
+    for (int i = (int)strlen("/lightnvr-frames-"); i < len; i++) {
+        char ch = exp->shm_name[i];
+        bool keep = (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') ||
+                    (ch >= '0' && ch <= '9') || ch == '_' || ch == '-';
+        if (!keep) {
+            exp->shm_name[i] = '_';
+        }
+    }
+
+    long page = sysconf(_SC_PAGESIZE);
+    if (page <= 0) {
+        page = 4096;
+    }
+    size_t data_offset = (sizeof(frame_export_header_t) + page - 1) / page * page;
+    size_t slot_size = ((size_t)max_size * max_size * 3 + page - 1) / page * page;
+    exp->map_size = data_offset + slot_size * slots;
+
+    // A segment left over by a crashed run is replaced
+    shm_unlink(exp->shm_name);
+    exp->fd = shm_open(exp->shm_name, O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0644);
+    if (exp->fd < 0) {
+        log_error("Frame export: failed to create %s: %s", exp->shm_name, strerror(errno));
+        destroy_exporter(exp);
+        return NULL;
+    }
+
+    if (ftruncate(exp->fd, (off_t)exp->map_size) != 0) {
+        log_error("Frame export: failed to size %s: %s", exp->shm_name, strerror(errno));
+        destroy_exporter(exp);
+        return NULL;
+    }
+
+    void *map = mmap(NULL, exp->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, exp->fd, 0);
+    if (map == MAP_FAILED) {
+        log_error("Frame export: failed to map %s: %s", exp->shm_name, strerror(errno));
+        destroy_exporter(exp);
+        return NULL;
+    }
+    exp->header = (frame_export_header_t *)map;
+
+    frame_export_header_t *header = exp->header;
+    header->version = FRAME_EXPORT_VERSION;
+    header->format = FRAME_EXPORT_FORMAT_RGB24;
+    header->slot_count = (uint32_t)slots;
+    header->max_width = (uint32_t)max_size;
+    header->max_height = (uint32_t)max_size;
+    header->slot_size = slot_size;
+    header->data_offset = data_offset;
+    header->writer_pid = (uint32_t)getpid();
+    // Readers check the magic last
+    __atomic_store_n(&header->magic, FRAME_EXPORT_MAGIC, __ATOMIC_RELEASE);
+
+    log_info("Frame export: publishing %s in %s (%d slots of up to %dx%d)",
+             stream_name, exp->shm_name, slots, max_size, max_size);
+    return exp;
+}
+
+/**
+ * Take a reference to the exporter of a stream, created on first use
+ */
+static frame_exporter_t *get_exporter(const char *stream_name) {
+    pthread_mutex_lock(&exporters_mutex);
+
+    int free_slot = -1;
+    for (int i = 0; i < MAX_STREAMS; i++) {
+        if (exporters[i] && strcmp(exporters[i]->stream_name, stream_name) == 0) {
+            frame_exporter_t *exp = exporters[i];
+            exp->refs++;
+            pthread_mutex_unlock(&exporters_mutex);
+            return exp;
+        }
+        if (!exporters[i] && free_slot < 0) {
+            free_slot = i;
+        }
+    }
+
+    frame_exporter_t *exp = NULL;
+    if (free_slot >= 0) {
+        exp = create_exporter(stream_name);
+        if (exp) {
+            exp->refs = 1;
+        }
+        exporters[free_slot] = exp;
+    }
+    pthread_mutex_unlock(&exporters_mutex);
+    return exp;
+}
+
+/**
+ * Drop a reference taken by get_exporter
+ */
+static void put_exporter(frame_exporter_t *exp) {
+    pthread_mutex_lock(&exporters_mutex);
+    if (--exp->refs == 0 && exp->closed) {
+        destroy_exporter(exp);
+    }
+    pthread_mutex_unlock(&exporters_mutex);
+}
+
+/**
+ * Take an exporter out of the table; it is freed once no publisher uses it
+ * Must be called with the exporters mutex held.
+ */
+static void remove_exporter(int index) {
+    frame_exporter_t *exp = exporters[index];
+    exporters[index] = NULL;
+    exp->closed = true;
+    if (exp->refs == 0) {
+        destroy_exporter(exp);
+    }
+}
+
+int frame_export_publish(const char *stream_name, const struct AVFrame *frame) {
+    if (!stream_name || !frame || !stream_exported(stream_name)) {
+        return 0;
+    }
+    if (frame->width <= 0 || frame->height <= 0) {
+        return -1;
+    }
+
+    frame_exporter_t *exp = get_exporter(stream_name);
+    if (!exp) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&exp->mutex);
+    frame_export_header_t *header = exp->header;
+
+    // Fit the frame in the slot, keeping its aspect ratio
+    int max_size = (int)header->max_width;
+    int width = frame->width;
+    int height = frame->height;
+    if (width > max_size || height > max_size) {
+        if (width >= height) {
+            height = (int)((int64_t)height * max_size / width);
+            width = max_size;
+        } else {
+            width = (int)((int64_t)width * max_size / height);
+            height = max_size;
+        }
+    }
+    width = width > 2 ? width & ~1 : 2;
+    height = height > 2 ? height & ~1 : 2;
+
+    exp->sws_ctx = sws_getCachedContext(exp->sws_ctx, frame->width, frame->height, frame->format,
+                                        width, height, AV_PIX_FMT_RGB24,
+                                        SWS_FAST_BILINEAR, NULL, NULL, NULL);
+    if (!exp->sws_ctx) {
+        log_error("Frame export: cannot convert %dx%d frames of %s", frame->width, frame->height, stream_name);
+        pthread_mutex_unlock(&exp->mutex);
+        put_exporter(exp);
+        return -1;
+    }
+
+    uint32_t index = (uint32_t)(exp->frame_number % header->slot_count);
+    frame_export_slot_t *slot = &header->slots[index];
+    uint8_t *pixels = (uint8_t *)header + header->data_offset + (size_t)index * header->slot_size;
+
+    // Odd sequence while the slot is written
+    uint32_t seq = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    uint8_t *dst_data[4] = {pixels, NULL, NULL, NULL};
+    int dst_linesize[4] = {width * 3, 0, 0, 0};
+    sws_scale(exp->sws_ctx, (const uint8_t *const *)frame->data, frame->linesize, 0, frame->height,
+              dst_data, dst_linesize);
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    slot->width = (uint32_t)width;
+    slot->height = (uint32_t)height;
+    slot->stride = (uint32_t)(width * 3);
+    slot->timestamp_ms = (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+    slot->frame_number = exp->frame_number;
+
+    __atomic_store_n(&slot->seq, seq + 2, __ATOMIC_RELEASE);
+    exp->frame_number++;
+    __atomic_store_n(&header->frame_seq, (uint32_t)exp->frame_number, __ATOMIC_RELEASE);
+
+    // Wake readers in other processes waiting for a frame
+    syscall(SYS_futex, &header->frame_seq, FUTEX_WAKE, INT32_MAX, NULL, NULL, 0);
+
+    pthread_mutex_unlock(&exp->mutex);
+    put_exporter(exp);
+    return 0;
+}
+
+void frame_export_close(const char *stream_name) {
+    if (!stream_name) {
+        return;
+    }
+
+    pthread_mutex_lock(&exporters_mutex);
+    for (int i = 0; i < MAX_STREAMS; i++) {
+        if (exporters[i] && strcmp(exporters[i]->stream_name, stream_name) == 0) {
+            log_info("Frame export: removing %s", exporters[i]->shm_name);
+            remove_exporter(i);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&exporters_mutex);
+}
+
+void frame_export_shutdown(void) {
+    pthread_mutex_lock(&exporters_mutex);
+    for (int i = 0; i < MAX_STREAMS; i++) {
+        if (exporters[i]) {
+            remove_exporter(i);
+        }
+    }
+    pthread_mutex_unlock(&exporters_mutex);
+}
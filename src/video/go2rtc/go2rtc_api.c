@@ -10,13 +10,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
-#include <sys/socket.h>
-#include <netinet/in.h>
-#include <arpa/inet.h>
-#include <netdb.h>
-#include <errno.h>
 #include <curl/curl.h>
 #include <ctype.h>
+#include <pthread.h>
 #include "../../external/cjson/cJSON.h"
 
 // API client configuration
@@ -28,6 +24,61 @@ static bool g_initialized = false;
 #define HTTP_BUFFER_SIZE 4096
 #define URL_BUFFER_SIZE 1024
 
+// Per-thread curl handles, see go2rtc_api_get_curl()
+static pthread_key_t g_curl_key;
+static pthread_once_t g_curl_key_once = PTHREAD_ONCE_INIT;
+
+static void free_thread_curl(void *curl) {
+    curl_easy_cleanup((CURL *)curl);
+}
+
+static void create_curl_key(void) {
+    pthread_key_create(&g_curl_key, free_thread_curl);
+}
+
+CURL *go2rtc_api_get_curl(void) {
+    pthread_once(&g_curl_key_once, create_curl_key);
+
+    CURL *curl = pthread_getspecific(g_curl_key);
+    if (curl) {
+        // Drops the options of the last request, keeps its connections
+        curl_easy_reset(curl);
+    } else {
+        curl = curl_easy_init();
+        if (!curl) {
+            return NULL;
+        }
+        pthread_setspecific(g_curl_key, curl);
+    }
+
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    return curl;
+}
+
+// Raw response of send_http_request(), headers included
+struct http_response {
+    char *buffer;
+    size_t size;
+    size_t used;
+};
+
+static size_t http_response_callback(void *contents, size_t size, size_t nmemb, void *userp) {
+    size_t realsize = size * nmemb;
+    struct http_response *resp = (struct http_response *)userp;
+
+    if (resp->used + realsize >= resp->size) {
+        log_warn("HTTP response truncated (buffer too small)");
+        realsize = resp->size - resp->used - 1;
+    }
+    memcpy(resp->buffer + resp->used, contents, realsize);
+    resp->used += realsize;
+    resp->buffer[resp->used] = '\0';
+
+    // Keep reading so the connection stays usable
+    return size * nmemb;
+}
+
 /**
  * @brief Send an HTTP request to the go2rtc API
  * 
@@ -40,95 +91,41 @@ static bool g_initialized = false;
  */
 static int send_http_request(const char *method, const char *path, const char *data, 
                              char *response, size_t response_size) {
-    struct hostent *server;
-    struct sockaddr_in server_addr;
-    int sockfd, bytes, status_code = -1;
-    char request[HTTP_BUFFER_SIZE];
-    char buffer[HTTP_BUFFER_SIZE];
-    
-    // Create socket
-    sockfd = socket(AF_INET, SOCK_STREAM, 0);
-    if (sockfd < 0) {
-        log_error("Failed to create socket: %s", strerror(errno));
-        return -1;
-    }
-    
-    // Resolve hostname
-    server = gethostbyname(g_api_host);
-    if (server == NULL) {
-        log_error("Failed to resolve hostname: %s", g_api_host);
-        close(sockfd);
-        return -1;
-    }
+    char url[URL_BUFFER_SIZE];
+    struct curl_slist *headers = NULL;
+    struct http_response resp = { response, response_size, 0 };
     
-    // Set up server address
-    memset(&server_addr, 0, sizeof(server_addr));
-    server_addr.sin_family = AF_INET;
-    memcpy(&server_addr.sin_addr.s_addr, server->h_addr_list[0], server->h_length);
-    server_addr.sin_port = htons(g_api_port);
+    memset(response, 0, response_size);
     
-    // Connect to server
-    if (connect(sockfd, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
-        log_error("Failed to connect to %s:%d: %s", g_api_host, g_api_port, strerror(errno));
-        close(sockfd);
+    CURL *curl = go2rtc_api_get_curl();
+    if (!curl) {
+        log_error("Failed to initialize CURL");
         return -1;
     }
     
-    // Prepare HTTP request
+    snprintf(url, sizeof(url), "http://%s:%d%s", g_api_host, g_api_port, path);
+    curl_easy_setopt(curl, CURLOPT_URL, url);
+    curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, method);
+    curl_easy_setopt(curl, CURLOPT_HEADER, 1L);  // Callers split headers and body
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, http_response_callback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &resp);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 10L);
     if (data) {
-        snprintf(request, sizeof(request),
-                 "%s %s HTTP/1.1\r\n"
-                 "Host: %s:%d\r\n"
-                 "Content-Type: application/json\r\n"
-                 "Content-Length: %zu\r\n"
-                 "Connection: close\r\n"
-                 "\r\n"
-                 "%s",
-                 method, path, g_api_host, g_api_port, strlen(data), data);
-    } else {
-        snprintf(request, sizeof(request),
-                 "%s %s HTTP/1.1\r\n"
-                 "Host: %s:%d\r\n"
-                 "Connection: close\r\n"
-                 "\r\n",
-                 method, path, g_api_host, g_api_port);
-    }
-    
-    // Send request
-    if (send(sockfd, request, strlen(request), 0) < 0) {
-        log_error("Failed to send HTTP request: %s", strerror(errno));
-        close(sockfd);
-        return -1;
+        headers = curl_slist_append(headers, "Content-Type: application/json");
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, data);
     }
     
-    // Receive response
-    memset(response, 0, response_size);
-    size_t total_bytes = 0;
-    
-    while ((bytes = recv(sockfd, buffer, sizeof(buffer) - 1, 0)) > 0) {
-        buffer[bytes] = '\0';
-        
-        // Extract status code from first line of response
-        if (status_code == -1) {
-            if (sscanf(buffer, "HTTP/1.1 %d", &status_code) != 1) {
-                log_error("Failed to parse HTTP status code");
-                close(sockfd);
-                return -1;
-            }
-        }
-        
-        // Append to response buffer if there's space
-        if (total_bytes + bytes < response_size) {
-            memcpy(response + total_bytes, buffer, bytes);
-            total_bytes += bytes;
-        } else {
-            log_warn("HTTP response truncated (buffer too small)");
-            break;
-        }
+    CURLcode res = curl_easy_perform(curl);
+    curl_slist_free_all(headers);
+    if (res != CURLE_OK) {
+        log_error("Failed to send HTTP request to %s:%d: %s", g_api_host, g_api_port, curl_easy_strerror(res));
+        return -1;
     }
     
-    close(sockfd);
-    return status_code;
+    long status_code = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status_code);
+    return (int)status_code;
 }
 
 /**
@@ -229,8 +226,8 @@ bool go2rtc_api_add_stream(const char *stream_id, const char *stream_url) {
     char url[URL_BUFFER_SIZE];
     bool success = false;
     
-    // Initialize CURL
-    curl = curl_easy_init();
+    // Get this thread's CURL handle
+    curl = go2rtc_api_get_curl();
     if (!curl) {
         log_error("Failed to initialize CURL");
         return false;
@@ -290,9 +287,6 @@ bool go2rtc_api_add_stream(const char *stream_id, const char *stream_url) {
         }
     }
     
-    // Clean up
-    curl_easy_cleanup(curl);
-    
     return success;
 }
 
@@ -312,8 +306,8 @@ bool go2rtc_api_remove_stream(const char *stream_id) {
     char url[URL_BUFFER_SIZE];
     bool success = false;
     
-    // Initialize CURL
-    curl = curl_easy_init();
+    // Get this thread's CURL handle
+    curl = go2rtc_api_get_curl();
     if (!curl) {
         log_error("Failed to initialize CURL");
         return false;
@@ -387,9 +381,6 @@ bool go2rtc_api_remove_stream(const char *stream_id) {
         }
     }
     
-    // Clean up
-    curl_easy_cleanup(curl);
-    
     return success;
 }
 
@@ -514,8 +505,8 @@ bool go2rtc_api_get_server_info(int *rtsp_port) {
     char url[URL_BUFFER_SIZE];
     bool success = false;
 
-    // Initialize CURL
-    curl = curl_easy_init();
+    // Get this thread's CURL handle
+    curl = go2rtc_api_get_curl();
     if (!curl) {
         log_error("Failed to initialize CURL");
         return false;
@@ -583,9 +574,6 @@ bool go2rtc_api_get_server_info(int *rtsp_port) {
         }
     }
 
-    // Clean up
-    curl_easy_cleanup(curl);
-
     return success;
 }
 
@@ -594,6 +582,14 @@ void go2rtc_api_cleanup(void) {
         return;
     }
 
+    // Threads that exit free their own handles, this one may not exit
+    pthread_once(&g_curl_key_once, create_curl_key);
+    CURL *curl = pthread_getspecific(g_curl_key);
+    if (curl) {
+        curl_easy_cleanup(curl);
+        pthread_setspecific(g_curl_key, NULL);
+    }
+
     free(g_api_host);
     g_api_host = NULL;
     g_api_port = 0;
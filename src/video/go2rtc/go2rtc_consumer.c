@@ -127,8 +127,8 @@ static bool add_go2rtc_recording_consumer(const char *stream_id, const char *out
     char url[URL_BUFFER_SIZE];
     bool success = false;
     
-    // Initialize CURL
-    curl = curl_easy_init();
+    // Get this thread's CURL handle
+    curl = go2rtc_api_get_curl();
     if (!curl) {
         log_error("Failed to initialize CURL");
         return false;
@@ -189,7 +189,6 @@ static bool add_go2rtc_recording_consumer(const char *stream_id, const char *out
     if (headers) {
         curl_slist_free_all(headers);
     }
-    curl_easy_cleanup(curl);
     
     return success;
 }
@@ -212,8 +211,8 @@ static bool remove_go2rtc_consumer(const char *stream_id, const char *consumer_t
     char url[URL_BUFFER_SIZE];
     bool success = false;
     
-    // Initialize CURL
-    curl = curl_easy_init();
+    // Get this thread's CURL handle
+    curl = go2rtc_api_get_curl();
     if (!curl) {
         log_error("Failed to initialize CURL");
         return false;
@@ -227,7 +226,6 @@ static bool remove_go2rtc_consumer(const char *stream_id, const char *consumer_t
     } else {
         // For HLS, we don't need to remove anything as we're using direct access
         log_info("No need to remove HLS consumer for stream %s", stream_id);
-        curl_easy_cleanup(curl);
         return true;
     }
     
@@ -258,9 +256,6 @@ static bool remove_go2rtc_consumer(const char *stream_id, const char *consumer_t
         }
     }
     
-    // Clean up
-    curl_easy_cleanup(curl);
-    
     return success;
 }
 
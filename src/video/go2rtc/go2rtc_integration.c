@@ -6,6 +6,7 @@
 #include "video/go2rtc/go2rtc_integration.h"
 #include "video/go2rtc/go2rtc_consumer.h"
 #include "video/go2rtc/go2rtc_stream.h"
+#include "video/go2rtc/go2rtc_process.h"
 #include "core/logger.h"
 #include "core/config.h"
 #include "core/shutdown_coordinator.h"  // For is_shutdown_initiated
@@ -15,11 +16,13 @@
 #include "video/streams.h"
 #include "database/db_streams.h"
 #include "video/stream_state.h"
+#include "video/stream_ingest.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <pthread.h>
 
 // Tracking for streams using go2rtc
 #define MAX_TRACKED_STREAMS 16
@@ -249,6 +252,34 @@ static bool ensure_stream_registered_with_go2rtc(const char *stream_name) {
     return true;
 }
 
+// Lets one ingest at a time restart go2rtc while the others wait for it
+static pthread_mutex_t g_upstream_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Hold back ingest reconnects to go2rtc until it can serve them
+ *
+ * In upstream mode go2rtc owns the camera connection and redials it itself,
+ * so an ingest only has to wait for go2rtc. If go2rtc is gone, the first
+ * ingest to notice restarts it and the rest wait on the mutex instead of
+ * all starting it at once.
+ */
+static void wait_for_go2rtc_upstream(const char *url, int timeout_ms) {
+    char prefix[64];
+    snprintf(prefix, sizeof(prefix), "rtsp://localhost:%d/", go2rtc_process_get_rtsp_port());
+    if (strncmp(url, prefix, strlen(prefix)) != 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&g_upstream_mutex);
+    if (!go2rtc_process_wait_ready(timeout_ms) || !go2rtc_stream_is_ready()) {
+        log_warn("go2rtc is not serving streams, restarting it before reconnecting ingests");
+        if (!go2rtc_stream_start_service()) {
+            log_error("Failed to restart go2rtc");
+        }
+    }
+    pthread_mutex_unlock(&g_upstream_mutex);
+}
+
 bool go2rtc_integration_init(void) {
     if (g_initialized) {
         log_warn("go2rtc integration module already initialized");
@@ -265,7 +296,13 @@ bool go2rtc_integration_init(void) {
     memset(g_tracked_streams, 0, sizeof(g_tracked_streams));
 
     g_initialized = true;
-    log_info("go2rtc integration module initialized");
+
+    if (g_config.go2rtc_upstream) {
+        stream_ingest_set_reconnect_gate(wait_for_go2rtc_upstream);
+        log_info("go2rtc integration module initialized, go2rtc is the upstream for all streams");
+    } else {
+        log_info("go2rtc integration module initialized");
+    }
 
     return true;
 }
@@ -535,6 +572,12 @@ bool go2rtc_integration_is_using_go2rtc_for_recording(const char *stream_name) {
         return false;
     }
 
+    // In upstream mode every consumer pulls the same go2rtc restream, so the
+    // shared ingest opens it once and go2rtc holds the only camera connection
+    if (g_config.go2rtc_upstream) {
+        return true;
+    }
+
     go2rtc_stream_tracking_t *tracking = find_tracked_stream(stream_name);
     return tracking ? tracking->using_go2rtc_for_recording : false;
 }
@@ -544,6 +587,10 @@ bool go2rtc_integration_is_using_go2rtc_for_hls(const char *stream_name) {
         return false;
     }
 
+    if (g_config.go2rtc_upstream) {
+        return true;
+    }
+
     go2rtc_stream_tracking_t *tracking = find_tracked_stream(stream_name);
     return tracking ? tracking->using_go2rtc_for_hls : false;
 }
@@ -566,11 +613,17 @@ bool go2rtc_integration_register_all_streams(void) {
     }
 
     // Get all stream configurations
-    stream_config_t streams[MAX_STREAMS];
-    int count = get_all_stream_configs(streams, MAX_STREAMS);
+    stream_config_t *streams = calloc(g_config.max_streams, sizeof(stream_config_t));
+    if (!streams) {
+        log_error("Failed to allocate memory for stream configurations");
+        return false;
+    }
+
+    int count = get_all_stream_configs(streams, g_config.max_streams);
 
     if (count <= 0) {
         log_info("No streams found to register with go2rtc");
+        free(streams);
         return true; // Not an error, just no streams
     }
 
@@ -595,6 +648,7 @@ bool go2rtc_integration_register_all_streams(void) {
         }
     }
 
+    free(streams);
     return all_success;
 }
 
@@ -605,6 +659,8 @@ void go2rtc_integration_cleanup(void) {
 
     log_info("Cleaning up go2rtc integration module");
 
+    stream_ingest_set_reconnect_gate(NULL);
+
     // Stop all recording and HLS streaming using go2rtc
     for (int i = 0; i < MAX_TRACKED_STREAMS; i++) {
         if (g_tracked_streams[i].stream_name[0] != '\0') {
@@ -3,10 +3,12 @@
  * @brief Implementation of the go2rtc process management module
  */
 
+#define _GNU_SOURCE
 #include "video/go2rtc/go2rtc_process.h"
 #include "video/go2rtc/go2rtc_api.h"
 #include "core/logger.h"
 #include "core/config.h"
+#include "video/thread_utils.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -18,6 +20,12 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <limits.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
 #include <curl/curl.h>
 
 // Define PATH_MAX if not defined
@@ -34,6 +42,29 @@ static char *g_config_path = NULL;
 static pid_t g_process_pid = -1;
 static bool g_initialized = false;
 static int g_rtsp_port = 8554; // Default RTSP port
+static int g_api_port = 1984;
+
+// Supervision of the go2rtc child we started: its output is read from a pipe
+// so we see the "listen" lines, and its exit is seen through a pidfd
+static pthread_t g_supervisor_thread;
+static bool g_supervised = false;
+static int g_output_fd = -1;
+static int g_log_fd = -1;
+static pthread_mutex_t g_state_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_state_cond = PTHREAD_COND_INITIALIZER;
+static bool g_api_listening = false;
+static bool g_rtsp_listening = false;
+static bool g_child_exited = false;
+
+// Streams written into the config, so go2rtc loads them at launch
+typedef struct {
+    char *name;
+    char *source;
+} config_stream_t;
+
+static config_stream_t *g_config_streams = NULL;
+static int g_config_stream_count = 0;
+static bool g_config_streams_loaded = false;  // Our running go2rtc was launched with them
 
 // Callback function for libcurl to discard response data
 static size_t discard_response_data(void *ptr, size_t size, size_t nmemb, void *userdata) {
@@ -239,6 +270,98 @@ bool go2rtc_process_init(const char *binary_path, const char *config_dir) {
     return true;
 }
 
+/**
+ * @brief Free the list of config streams
+ * Must be called with g_state_mutex held.
+ */
+static void free_config_streams(void) {
+    for (int i = 0; i < g_config_stream_count; i++) {
+        free(g_config_streams[i].name);
+        free(g_config_streams[i].source);
+    }
+    free(g_config_streams);
+    g_config_streams = NULL;
+    g_config_stream_count = 0;
+    g_config_streams_loaded = false;
+}
+
+bool go2rtc_process_set_config_streams(const char *const *names, const char *const *sources, int count) {
+    config_stream_t *streams = NULL;
+
+    if (count > 0) {
+        streams = calloc((size_t)count, sizeof(config_stream_t));
+        if (!streams) {
+            log_error("Failed to allocate memory for go2rtc config streams");
+            return false;
+        }
+        for (int i = 0; i < count; i++) {
+            streams[i].name = strdup(names[i]);
+            streams[i].source = strdup(sources[i]);
+            if (!streams[i].name || !streams[i].source) {
+                log_error("Failed to allocate memory for go2rtc config streams");
+                for (int j = 0; j <= i; j++) {
+                    free(streams[j].name);
+                    free(streams[j].source);
+                }
+                free(streams);
+                return false;
+            }
+        }
+    }
+
+    pthread_mutex_lock(&g_state_mutex);
+    free_config_streams();
+    g_config_streams = streams;
+    g_config_stream_count = count > 0 ? count : 0;
+    pthread_mutex_unlock(&g_state_mutex);
+
+    return true;
+}
+
+bool go2rtc_process_config_has_stream(const char *name, const char *source) {
+    bool found = false;
+
+    pthread_mutex_lock(&g_state_mutex);
+    if (g_config_streams_loaded && !g_child_exited) {
+        for (int i = 0; i < g_config_stream_count; i++) {
+            if (strcmp(g_config_streams[i].name, name) == 0) {
+                found = strcmp(g_config_streams[i].source, source) == 0;
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&g_state_mutex);
+
+    return found;
+}
+
+void go2rtc_process_forget_config_stream(const char *name) {
+    pthread_mutex_lock(&g_state_mutex);
+    for (int i = 0; i < g_config_stream_count; i++) {
+        if (strcmp(g_config_streams[i].name, name) == 0) {
+            free(g_config_streams[i].name);
+            free(g_config_streams[i].source);
+            g_config_streams[i] = g_config_streams[--g_config_stream_count];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&g_state_mutex);
+}
+
+/**
+ * @brief Write a string as a double-quoted YAML scalar
+ */
+static void write_yaml_string(FILE *file, const char *str) {
+    fputc('"', file);
+    for (const char *p = str; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            fputc('\\', file);
+        }
+        fputc(*p, file);
+    }
+    fputc('"', file);
+}
+
 bool go2rtc_process_generate_config(const char *config_path, int api_port) {
     if (!g_initialized) {
         log_error("go2rtc process manager not initialized");
@@ -288,19 +411,36 @@ bool go2rtc_process_generate_config(const char *config_path, int api_port) {
     fprintf(config_file, "  h264: \"-codec:v libx264 -g:v 30 -preset:v superfast\"\n");
     fprintf(config_file, "  h265: \"-codec:v libx265 -g:v 30 -preset:v superfast\"\n");
 
-    // Streams section (will be populated dynamically)
+    // Streams section, go2rtc loads these at launch and later changes go
+    // through the API
     fprintf(config_file, "streams:\n");
-    fprintf(config_file, "  # Streams will be added dynamically\n");
+    pthread_mutex_lock(&g_state_mutex);
+    int stream_count = g_config_stream_count;
+    for (int i = 0; i < g_config_stream_count; i++) {
+        fprintf(config_file, "  ");
+        write_yaml_string(config_file, g_config_streams[i].name);
+        fprintf(config_file, ": ");
+        write_yaml_string(config_file, g_config_streams[i].source);
+        fprintf(config_file, "\n");
+    }
+    pthread_mutex_unlock(&g_state_mutex);
+    if (stream_count == 0) {
+        fprintf(config_file, "  # Streams will be added dynamically\n");
+    }
 
     fclose(config_file);
-    log_info("Generated go2rtc configuration file: %s", config_path);
+    log_info("Generated go2rtc configuration file: %s with %d streams", config_path, stream_count);
 
-    // Print the content of the config file for debugging
+    // Print the content of the config file for debugging, except the stream
+    // sources which may carry camera credentials
     FILE *read_file = fopen(config_path, "r");
     if (read_file) {
         char line[256];
         log_info("Contents of go2rtc config file:");
         while (fgets(line, sizeof(line), read_file)) {
+            if (strncmp(line, "streams:", 8) == 0) {
+                break;
+            }
             // Remove newline character
             size_t len = strlen(line);
             if (len > 0 && line[len-1] == '\n') {
@@ -565,6 +705,334 @@ static bool kill_all_go2rtc_processes(void) {
     return success;
 }
 
+/**
+ * @brief Get the path of the go2rtc log file
+ *
+ * The log goes next to the main log file, or into the config directory if
+ * there is no main log file.
+ */
+static void get_go2rtc_log_path(char *log_path, size_t size) {
+    char log_dir[1024] = {0};
+
+    if (g_config.log_file[0] != '\0') {
+        strncpy(log_dir, g_config.log_file, sizeof(log_dir) - 1);
+
+        // Find the last slash to get the directory
+        char *last_slash = strrchr(log_dir, '/');
+        if (last_slash) {
+            *(last_slash + 1) = '\0';
+            snprintf(log_path, size, "%sgo2rtc.log", log_dir);
+            return;
+        }
+    }
+
+    snprintf(log_path, size, "%s/go2rtc.log", g_config_dir);
+}
+
+/**
+ * @brief Get the port from the addr field of a go2rtc log line
+ *
+ * Handles both the text format (addr=:1984) and the JSON format
+ * ("addr":":1984").
+ *
+ * @return int The port, or 0 if there is none
+ */
+static int parse_listen_port(const char *line) {
+    const char *value = strstr(line, "addr=");
+    if (value) {
+        value += strlen("addr=");
+    } else {
+        value = strstr(line, "\"addr\":\"");
+        if (!value) {
+            return 0;
+        }
+        value += strlen("\"addr\":\"");
+    }
+
+    const char *colon = NULL;
+    for (const char *p = value; *p && *p != ' ' && *p != '"'; p++) {
+        if (*p == ':') {
+            colon = p;
+        }
+    }
+    return colon ? atoi(colon + 1) : 0;
+}
+
+/**
+ * @brief Look for the listen lines go2rtc prints once its servers are up
+ */
+static void scan_output_line(const char *line) {
+    if (!strstr(line, "listen")) {
+        return;
+    }
+
+    bool api = strstr(line, "[api]") || strstr(line, "\"module\":\"api\"");
+    bool rtsp = strstr(line, "[rtsp]") || strstr(line, "\"module\":\"rtsp\"");
+    if (!api && !rtsp) {
+        return;
+    }
+
+    pthread_mutex_lock(&g_state_mutex);
+    if (api && !g_api_listening) {
+        g_api_listening = true;
+        log_info("go2rtc API is listening");
+        pthread_cond_broadcast(&g_state_cond);
+    }
+    if (rtsp && !g_rtsp_listening) {
+        int port = parse_listen_port(line);
+        if (port > 0) {
+            g_rtsp_port = port;
+            g_rtsp_listening = true;
+            log_info("go2rtc RTSP server is listening on port %d", port);
+        }
+    }
+    pthread_mutex_unlock(&g_state_mutex);
+}
+
+/**
+ * @brief Supervise the go2rtc child until it exits
+ *
+ * Copies the child's output to the go2rtc log, scanning it for the listen
+ * lines, and reaps the child when its pidfd becomes readable. Without pidfd
+ * support, the end of the output stands in for the exit.
+ */
+static void *supervise_go2rtc(void *arg) {
+    pid_t pid = (pid_t)(intptr_t)arg;
+    thread_set_identity(THREAD_CLASS_SERVICE, "go2rtc-mon", NULL);
+    int pidfd = -1;
+    char buf[4096];
+    char line[1024];
+    size_t line_len = 0;
+    bool output_open = true;
+    bool exited = false;
+    int status = 0;
+
+#ifdef SYS_pidfd_open
+    pidfd = (int)syscall(SYS_pidfd_open, pid, 0);
+#endif
+
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd >= 0) {
+        struct epoll_event ev = { .events = EPOLLIN, .data.fd = g_output_fd };
+        epoll_ctl(epfd, EPOLL_CTL_ADD, g_output_fd, &ev);
+        if (pidfd >= 0) {
+            ev.data.fd = pidfd;
+            epoll_ctl(epfd, EPOLL_CTL_ADD, pidfd, &ev);
+        }
+    } else {
+        log_warn("Failed to create epoll instance for go2rtc: %s", strerror(errno));
+    }
+
+    while (!exited) {
+        if (epfd < 0 || (!output_open && pidfd < 0)) {
+            // Nothing left to watch, wait for the exit directly
+            while (output_open) {
+                ssize_t n = read(g_output_fd, buf, sizeof(buf));
+                if (n <= 0 && !(n < 0 && errno == EINTR)) {
+                    output_open = false;
+                }
+            }
+            while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+            }
+            exited = true;
+            break;
+        }
+
+        struct epoll_event events[2];
+        int count = epoll_wait(epfd, events, 2, -1);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            log_error("epoll_wait failed while supervising go2rtc: %s", strerror(errno));
+            close(epfd);
+            epfd = -1;
+            continue;
+        }
+
+        for (int i = 0; i < count; i++) {
+            if (events[i].data.fd == pidfd) {
+                if (waitpid(pid, &status, WNOHANG) == pid) {
+                    exited = true;
+                }
+                continue;
+            }
+
+            ssize_t n = read(g_output_fd, buf, sizeof(buf));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                epoll_ctl(epfd, EPOLL_CTL_DEL, g_output_fd, NULL);
+                output_open = false;
+                continue;
+            }
+
+            if (g_log_fd >= 0 && write(g_log_fd, buf, (size_t)n) < 0) {
+                // The log is best effort, keep supervising
+            }
+
+            for (ssize_t j = 0; j < n; j++) {
+                if (buf[j] == '\n') {
+                    line[line_len] = '\0';
+                    scan_output_line(line);
+                    line_len = 0;
+                } else if (line_len < sizeof(line) - 1) {
+                    line[line_len++] = buf[j];
+                }
+            }
+        }
+    }
+
+    if (epfd >= 0) {
+        close(epfd);
+    }
+    if (pidfd >= 0) {
+        close(pidfd);
+    }
+
+    if (WIFEXITED(status)) {
+        log_warn("go2rtc process %d exited with status %d", pid, WEXITSTATUS(status));
+    } else if (WIFSIGNALED(status)) {
+        log_info("go2rtc process %d was terminated by signal %d", pid, WTERMSIG(status));
+    }
+
+    pthread_mutex_lock(&g_state_mutex);
+    g_child_exited = true;
+    pthread_cond_broadcast(&g_state_cond);
+    pthread_mutex_unlock(&g_state_mutex);
+
+    return NULL;
+}
+
+/**
+ * @brief Get the absolute time timeout_ms from now, for pthread_cond_timedwait
+ */
+static void get_deadline(struct timespec *deadline, int timeout_ms) {
+    clock_gettime(CLOCK_REALTIME, deadline);
+    deadline->tv_sec += timeout_ms / 1000;
+    deadline->tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (deadline->tv_nsec >= 1000000000L) {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000L;
+    }
+}
+
+/**
+ * @brief Join the supervisor thread once the child has exited
+ */
+static void join_supervisor(void) {
+    if (!g_supervised) {
+        return;
+    }
+
+    pthread_join(g_supervisor_thread, NULL);
+    g_supervised = false;
+
+    close(g_output_fd);
+    g_output_fd = -1;
+    if (g_log_fd >= 0) {
+        close(g_log_fd);
+        g_log_fd = -1;
+    }
+}
+
+/**
+ * @brief Stop the go2rtc child we started, waiting for its exit
+ *
+ * @param timeout_ms Time to wait after SIGTERM before sending SIGKILL
+ */
+static void stop_supervised_child(int timeout_ms) {
+    if (!g_supervised) {
+        return;
+    }
+
+    pthread_mutex_lock(&g_state_mutex);
+    if (!g_child_exited) {
+        log_info("Sending SIGTERM to go2rtc process %d", g_process_pid);
+        kill(g_process_pid, SIGTERM);
+
+        struct timespec deadline;
+        get_deadline(&deadline, timeout_ms);
+        while (!g_child_exited &&
+               pthread_cond_timedwait(&g_state_cond, &g_state_mutex, &deadline) != ETIMEDOUT) {
+        }
+
+        if (!g_child_exited) {
+            log_warn("go2rtc process %d did not exit after SIGTERM, sending SIGKILL", g_process_pid);
+            kill(g_process_pid, SIGKILL);
+        }
+    }
+    pthread_mutex_unlock(&g_state_mutex);
+
+    join_supervisor();
+    g_process_pid = -1;
+}
+
+/**
+ * @brief Check whether the go2rtc API answers a request
+ */
+static bool is_api_responding(int api_port) {
+    char url[256];
+    long http_code = 0;
+
+    CURL *curl = curl_easy_init();
+    if (!curl) {
+        return false;
+    }
+
+    snprintf(url, sizeof(url), "http://localhost:%d/api", api_port);
+    curl_easy_setopt(curl, CURLOPT_URL, url);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, discard_response_data);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, 500L);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+
+    if (curl_easy_perform(curl) == CURLE_OK) {
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
+    }
+    curl_easy_cleanup(curl);
+
+    return http_code == 200 || http_code == 401;
+}
+
+bool go2rtc_process_wait_ready(int timeout_ms) {
+    if (!g_initialized) {
+        return false;
+    }
+
+    if (!g_supervised) {
+        // A go2rtc we did not start, all we can do is ask its API
+        for (int waited = 0; ; waited += GO2RTC_READY_POLL_MS) {
+            if (is_api_responding(g_api_port)) {
+                return true;
+            }
+            if (waited >= timeout_ms) {
+                return false;
+            }
+            usleep(GO2RTC_READY_POLL_MS * 1000);
+        }
+    }
+
+    struct timespec deadline;
+    get_deadline(&deadline, timeout_ms);
+
+    pthread_mutex_lock(&g_state_mutex);
+    while (!g_api_listening && !g_child_exited &&
+           pthread_cond_timedwait(&g_state_cond, &g_state_mutex, &deadline) != ETIMEDOUT) {
+    }
+    bool ready = g_api_listening && !g_child_exited;
+    bool exited = g_child_exited;
+    pthread_mutex_unlock(&g_state_mutex);
+
+    if (exited) {
+        log_error("go2rtc process exited before its API was ready");
+    } else if (!ready) {
+        log_warn("go2rtc did not report its API listening within %d ms", timeout_ms);
+    }
+
+    return ready;
+}
+
 bool go2rtc_process_is_running(void) {
     if (!g_initialized) {
         return false;
@@ -651,6 +1119,8 @@ bool go2rtc_process_start(int api_port) {
         return false;
     }
 
+    g_api_port = api_port;
+
     // Check if go2rtc is already running as a service
     if (is_go2rtc_running_as_service(api_port)) {
         log_info("go2rtc is already running as a service on port %d, using existing service", api_port);
@@ -796,162 +1266,112 @@ bool go2rtc_process_start(int api_port) {
         // Continue anyway, this is not critical
     }
 
+    // Collect the old supervisor if the previous go2rtc has exited
+    join_supervisor();
+
+    // The child's output goes through a pipe so we can see when it listens
+    char log_path[1024];
+    get_go2rtc_log_path(log_path, sizeof(log_path));
+    log_info("Using go2rtc log file: %s", log_path);
+
+    int output_pipe[2];
+    if (pipe2(output_pipe, O_CLOEXEC) != 0) {
+        log_error("Failed to create pipe for go2rtc output: %s", strerror(errno));
+        return false;
+    }
+
+    g_log_fd = open(log_path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (g_log_fd == -1) {
+        log_warn("Failed to open go2rtc log file %s: %s", log_path, strerror(errno));
+    }
+
+    pthread_mutex_lock(&g_state_mutex);
+    g_api_listening = false;
+    g_rtsp_listening = false;
+    g_child_exited = false;
+    g_config_streams_loaded = false;
+    pthread_mutex_unlock(&g_state_mutex);
+
     // Fork a new process
     pid_t pid = fork();
 
     if (pid < 0) {
         // Fork failed
         log_error("Failed to fork process for go2rtc: %s", strerror(errno));
+        close(output_pipe[0]);
+        close(output_pipe[1]);
+        if (g_log_fd >= 0) {
+            close(g_log_fd);
+            g_log_fd = -1;
+        }
         return false;
     } else if (pid == 0) {
-        // Child process
-
-        // Redirect stdout and stderr to log files
-        char log_path[1024]; // Use a reasonable fixed size instead of PATH_MAX
-
-        // Extract directory from g_config->log_file
-        char log_dir[1024] = {0};
-        if (g_config.log_file[0] != '\0') {
-            strncpy(log_dir, g_config.log_file, sizeof(log_dir) - 1);
-
-            // Find the last slash to get the directory
-            char *last_slash = strrchr(log_dir, '/');
-            if (last_slash) {
-                // Truncate at the last slash to get just the directory
-                *(last_slash + 1) = '\0';
-                // Create the go2rtc log path in the same directory as the main log file
-                snprintf(log_path, sizeof(log_path), "%sgo2rtc.log", log_dir);
-            } else {
-                // No directory in the path, fall back to g_config_dir
-                snprintf(log_path, sizeof(log_path), "%s/go2rtc.log", g_config_dir);
-            }
-        } else {
-            // If g_config.log_file is empty, fall back to g_config_dir
-            snprintf(log_path, sizeof(log_path), "%s/go2rtc.log", g_config_dir);
-        }
-
-        // Log the path we're using for the log file
-        log_info("Using go2rtc log file: %s", log_path);
-
-        int log_fd = open(log_path, O_WRONLY | O_CREAT | O_APPEND, 0644);
-        if (log_fd == -1) {
-            log_error("Failed to open log file: %s", log_path);
-            exit(EXIT_FAILURE);
-        }
-
-        dup2(log_fd, STDOUT_FILENO);
-        dup2(log_fd, STDERR_FILENO);
-        close(log_fd);
+        // Child process, send stdout and stderr to the pipe
+        dup2(output_pipe[1], STDOUT_FILENO);
+        dup2(output_pipe[1], STDERR_FILENO);
 
         // Execute go2rtc with explicit config path (using correct argument format)
-        log_info("Executing go2rtc with command: %s --config %s", g_binary_path, g_config_path);
         execl(g_binary_path, g_binary_path, "--config", g_config_path, NULL);
 
         // If execl returns, it failed
         fprintf(stderr, "Failed to execute go2rtc: %s\n", strerror(errno));
-        exit(EXIT_FAILURE);
-    } else {
-        // Parent process
-        g_process_pid = pid;
-        log_info("Started go2rtc process with PID: %d", pid);
-
-        // Wait a moment for the process to start
-        sleep(1);
+        _exit(EXIT_FAILURE);
+    }
 
-        // Verify the process is still running
-        if (kill(pid, 0) != 0) {
-            log_error("go2rtc process %d failed to start", pid);
-            g_process_pid = -1;
-            return false;
+    // Parent process
+    close(output_pipe[1]);
+    g_output_fd = output_pipe[0];
+    g_process_pid = pid;
+    log_info("Started go2rtc process with PID: %d", pid);
+
+    if (pthread_create(&g_supervisor_thread, NULL, supervise_go2rtc, (void *)(intptr_t)pid) != 0) {
+        log_error("Failed to create go2rtc supervisor thread");
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+        close(g_output_fd);
+        g_output_fd = -1;
+        if (g_log_fd >= 0) {
+            close(g_log_fd);
+            g_log_fd = -1;
         }
+        g_process_pid = -1;
+        return false;
+    }
+    g_supervised = true;
 
-        // Wait for the API to be ready with increased retries
-        log_info("Waiting for go2rtc API to be ready...");
-        int api_retries = 10;
-        bool api_ready = false;
-
-        while (api_retries > 0 && !api_ready) {
-            // Use libcurl to check if the API is ready
-            CURL *curl;
-            CURLcode res;
-            char url[256];
-            long http_code = 0;
-
-            // Initialize curl
-            curl = curl_easy_init();
-            if (!curl) {
-                log_warn("Failed to initialize curl");
-                sleep(1);
-                api_retries--;
-                continue;
-            }
-
-            // Format the URL for the API endpoint
-            snprintf(url, sizeof(url), "http://localhost:%d/api", api_port);
-
-            // Set curl options
-            curl_easy_setopt(curl, CURLOPT_URL, url);
-            curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, discard_response_data);
-            curl_easy_setopt(curl, CURLOPT_TIMEOUT, 2L); // 2 second timeout
-            curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 2L); // 2 second connect timeout
-            curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L); // Prevent curl from using signals
-
-            // Perform the request
-            res = curl_easy_perform(curl);
-
-            // Check for errors
-            if (res != CURLE_OK) {
-                log_warn("Curl request failed: %s", curl_easy_strerror(res));
-                curl_easy_cleanup(curl);
-                sleep(1);
-                api_retries--;
-                continue;
-            }
-
-            // Get the HTTP response code
-            curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
-
-            // Clean up
-            curl_easy_cleanup(curl);
-
-            if (http_code == 200 || http_code == 401) {
-                log_info("go2rtc API is ready (HTTP %ld)", http_code);
-                api_ready = true;
-                break;
-            }
-
-            log_info("Waiting for go2rtc API to be ready... (%d retries left)", api_retries);
-            sleep(1);
-            api_retries--;
-        }
+    // Wait for go2rtc to report its API listening, or to exit
+    log_info("Waiting for go2rtc API to be ready...");
+    if (!go2rtc_process_wait_ready(GO2RTC_READY_TIMEOUT_MS)) {
+        pthread_mutex_lock(&g_state_mutex);
+        bool exited = g_child_exited;
+        pthread_mutex_unlock(&g_state_mutex);
 
-        if (!api_ready) {
-            log_warn("go2rtc API did not become ready within timeout, but process is running");
-            // Continue anyway, as the process might still be starting up
+        if (exited) {
+            join_supervisor();
+            g_process_pid = -1;
+            return false;
         }
+        // Continue anyway, as the process might still be starting up
+    }
 
-        // Try to get the RTSP port from the API with multiple retries
-        log_info("Attempting to retrieve RTSP port from go2rtc API...");
-        int retries = 10;  // Increased retries
-        bool got_rtsp_port = false;
+    pthread_mutex_lock(&g_state_mutex);
+    g_config_streams_loaded = true;
+    pthread_mutex_unlock(&g_state_mutex);
 
-        while (retries > 0 && !got_rtsp_port) {
-            if (go2rtc_api_get_server_info(&g_rtsp_port)) {
-                log_info("Retrieved RTSP port from go2rtc API: %d", g_rtsp_port);
-                got_rtsp_port = true;
-            } else {
-                log_warn("Could not retrieve RTSP port from go2rtc API, retrying... (%d retries left)", retries);
-                sleep(1);
-                retries--;
-            }
-        }
+    // The RTSP server usually reports its port before the API does
+    pthread_mutex_lock(&g_state_mutex);
+    bool got_rtsp_port = g_rtsp_listening;
+    pthread_mutex_unlock(&g_state_mutex);
 
-        if (!got_rtsp_port) {
-            log_warn("Could not retrieve RTSP port from go2rtc API after multiple attempts, using default: %d", g_rtsp_port);
+    if (!got_rtsp_port) {
+        if (go2rtc_api_get_server_info(&g_rtsp_port)) {
+            log_info("Retrieved RTSP port from go2rtc API: %d", g_rtsp_port);
+        } else {
+            log_warn("Could not retrieve RTSP port from go2rtc, using default: %d", g_rtsp_port);
         }
-
-        return true;
     }
+
+    return true;
 }
 
 /**
@@ -973,6 +1393,9 @@ bool go2rtc_process_stop(void) {
     if (g_binary_path && g_binary_path[0] != '\0') {
         log_info("Stopping go2rtc process that we started");
 
+        // Our own child first, its exit is seen as soon as it happens
+        stop_supervised_child(GO2RTC_STOP_TIMEOUT_MS);
+
         // Kill all go2rtc processes, not just the one we started
         bool result = kill_all_go2rtc_processes();
 
@@ -1000,11 +1423,16 @@ void go2rtc_process_cleanup(void) {
     // Only stop go2rtc if we started it (g_binary_path is not empty)
     if (g_binary_path && g_binary_path[0] != '\0') {
         log_info("Stopping go2rtc process that we started during cleanup");
+        stop_supervised_child(GO2RTC_STOP_TIMEOUT_MS);
         kill_all_go2rtc_processes();
     } else {
         log_info("Not stopping go2rtc during cleanup as we're using an existing service");
     }
 
+    pthread_mutex_lock(&g_state_mutex);
+    free_config_streams();
+    pthread_mutex_unlock(&g_state_mutex);
+
     // Free allocated memory
     free(g_binary_path);
     free(g_config_dir);
@@ -0,0 +1,189 @@
+/**
+ * Generation-counted Handle Table
+ *
+ * All operations are lock-free: allocation claims a free slot by bumping its
+ * generation with a CAS, and every other operation compares the generation of
+ * the handle with the one in the slot word before acting on it.
+ */
+
+#include <stddef.h>
+
+#include "video/handle_table.h"
+
+#define STATE_GENERATION(state) ((uint32_t)((state) >> 32))
+#define STATE_FLAGS(state) ((uint32_t)((state) & 0xFFFFFFFFu))
+#define MAKE_STATE(generation, flags) (((uint64_t)(generation) << 32) | (uint32_t)(flags))
+
+#define HANDLE_GENERATION(handle) ((uint32_t)((handle) >> 32))
+#define HANDLE_INDEX(handle) ((uint32_t)((handle) & 0xFFFFFFFFu))
+#define MAKE_HANDLE(generation, index) (((uint64_t)(generation) << 32) | (uint32_t)(index))
+
+/**
+ * Get the slot of a handle, or NULL for an out-of-range or invalid handle
+ */
+static handle_slot_t *handle_slot(handle_table_t *table, handle_t handle) {
+    if (!table || handle == HANDLE_INVALID || HANDLE_INDEX(handle) >= HANDLE_TABLE_SLOTS) {
+        return NULL;
+    }
+    return &table->slots[HANDLE_INDEX(handle)];
+}
+
+/**
+ * Allocate a handle for a pointer
+ */
+handle_t handle_table_insert(handle_table_t *table, void *ptr) {
+    if (!table) {
+        return HANDLE_INVALID;
+    }
+
+    for (uint32_t i = 0; i < HANDLE_TABLE_SLOTS; i++) {
+        handle_slot_t *slot = &table->slots[i];
+        uint64_t state = atomic_load(&slot->state);
+
+        while ((STATE_GENERATION(state) & 1) == 0) {
+            uint32_t generation = STATE_GENERATION(state) + 1;
+            if (atomic_compare_exchange_weak(&slot->state, &state, MAKE_STATE(generation, 0))) {
+                // Nobody holds the new handle yet, so the pointer can be set afterwards
+                atomic_store(&slot->ptr, ptr);
+                return MAKE_HANDLE(generation, i);
+            }
+        }
+    }
+
+    return HANDLE_INVALID;
+}
+
+/**
+ * Invalidate a handle and free its slot
+ */
+int handle_table_release(handle_table_t *table, handle_t handle) {
+    handle_slot_t *slot = handle_slot(table, handle);
+    if (!slot) {
+        return -1;
+    }
+
+    uint64_t state = atomic_load(&slot->state);
+    while (STATE_GENERATION(state) == HANDLE_GENERATION(handle)) {
+        // The pointer is left in place; readers re-check the generation after loading it
+        if (atomic_compare_exchange_weak(&slot->state, &state,
+                                         MAKE_STATE(HANDLE_GENERATION(handle) + 1, 0))) {
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * Check whether a handle is still valid
+ */
+bool handle_table_is_valid(handle_table_t *table, handle_t handle) {
+    handle_slot_t *slot = handle_slot(table, handle);
+    return slot && STATE_GENERATION(atomic_load(&slot->state)) == HANDLE_GENERATION(handle);
+}
+
+/**
+ * Get the pointer registered for a handle
+ */
+void *handle_table_get(handle_table_t *table, handle_t handle) {
+    handle_slot_t *slot = handle_slot(table, handle);
+    if (!slot || STATE_GENERATION(atomic_load(&slot->state)) != HANDLE_GENERATION(handle)) {
+        return NULL;
+    }
+
+    void *ptr = atomic_load(&slot->ptr);
+
+    // The slot may have been released and reused while loading the pointer
+    if (STATE_GENERATION(atomic_load(&slot->state)) != HANDLE_GENERATION(handle)) {
+        return NULL;
+    }
+    return ptr;
+}
+
+/**
+ * Set flags on a handle
+ */
+int handle_table_set_flags(handle_table_t *table, handle_t handle, uint32_t flags) {
+    handle_slot_t *slot = handle_slot(table, handle);
+    if (!slot) {
+        return -1;
+    }
+
+    uint64_t state = atomic_load(&slot->state);
+    while (STATE_GENERATION(state) == HANDLE_GENERATION(handle)) {
+        if (atomic_compare_exchange_weak(&slot->state, &state, state | flags)) {
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * Clear flags on a handle
+ */
+int handle_table_clear_flags(handle_table_t *table, handle_t handle, uint32_t flags) {
+    handle_slot_t *slot = handle_slot(table, handle);
+    if (!slot) {
+        return -1;
+    }
+
+    uint64_t state = atomic_load(&slot->state);
+    while (STATE_GENERATION(state) == HANDLE_GENERATION(handle)) {
+        if (atomic_compare_exchange_weak(&slot->state, &state, state & ~(uint64_t)flags)) {
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * Get the flags of a handle
+ */
+int handle_table_get_flags(handle_table_t *table, handle_t handle, uint32_t *flags) {
+    handle_slot_t *slot = handle_slot(table, handle);
+    if (!slot) {
+        return -1;
+    }
+
+    uint64_t state = atomic_load(&slot->state);
+    if (STATE_GENERATION(state) != HANDLE_GENERATION(handle)) {
+        return -1;
+    }
+
+    if (flags) {
+        *flags = STATE_FLAGS(state);
+    }
+    return 0;
+}
+
+/**
+ * Get the handle currently allocated in a slot
+ */
+handle_t handle_table_handle_at(handle_table_t *table, int index) {
+    if (!table || index < 0 || index >= HANDLE_TABLE_SLOTS) {
+        return HANDLE_INVALID;
+    }
+
+    uint32_t generation = STATE_GENERATION(atomic_load(&table->slots[index].state));
+    return (generation & 1) ? MAKE_HANDLE(generation, index) : HANDLE_INVALID;
+}
+
+/**
+ * Find the handle registered for a pointer
+ */
+handle_t handle_table_find(handle_table_t *table, const void *ptr) {
+    if (!table || !ptr) {
+        return HANDLE_INVALID;
+    }
+
+    for (int i = 0; i < HANDLE_TABLE_SLOTS; i++) {
+        handle_t handle = handle_table_handle_at(table, i);
+        if (handle != HANDLE_INVALID && handle_table_get(table, handle) == ptr) {
+            return handle;
+        }
+    }
+
+    return HANDLE_INVALID;
+}
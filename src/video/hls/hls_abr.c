@@ -0,0 +1,807 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/opt.h>
+#include <libavutil/time.h>
+#include <libswscale/swscale.h>
+
+#include "core/config.h"
+#include "core/logger.h"
+#include "core/shutdown_coordinator.h"
+#include "video/ffmpeg_utils.h"
+#include "video/hw_decode.h"
+#include "video/stream_ingest.h"
+#include "video/stream_manager.h"
+#include "video/stream_transcoding.h"
+#include "video/thread_utils.h"
+#include "video/hls/hls_unified_thread.h"
+#include "video/hls/hls_abr.h"
+
+// Segment length of the renditions; key frames are placed on it
+#define ABR_SEGMENT_SECONDS 2
+#define ABR_PLAYLIST_SIZE 5
+#define ABR_MIN_HEIGHT 144
+#define ABR_MAX_HEIGHT 2160
+
+// The configured renditions, plus the H.264 version of an HEVC stream
+#define ABR_MAX_VARIANTS (HLS_ABR_MAX_RENDITIONS + 1)
+
+/**
+ * One rendition of a stream
+ * requested_us is guarded by abr_mutex, the rest belongs to the transcoder thread.
+ */
+typedef struct {
+    int height;
+    int64_t requested_us;           // av_gettime_relative() of the last request, 0 for none
+    bool failed;                    // Could not be written; retried by the next transcoder
+    transcode_encoder_t encoder;
+    struct SwsContext *sws_ctx;
+    AVFrame *scaled;
+    AVFormatContext *muxer;         // Open while the rendition is written
+    int64_t last_pts;
+    char dir[MAX_PATH_LENGTH];
+} abr_rendition_t;
+
+// Transcoder of one stream, freed by its thread
+typedef struct {
+    char stream_name[MAX_STREAM_NAME];
+    char url[MAX_URL_LENGTH];
+    int protocol;
+    atomic_int running;             // Cleared under abr_mutex once the thread is leaving
+    abr_rendition_t renditions[ABR_MAX_VARIANTS];
+    int rendition_count;
+} abr_transcoder_t;
+
+static abr_transcoder_t *transcoders[MAX_STREAMS];
+static pthread_mutex_t abr_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Width of a rendition keeping the source's aspect ratio, 16:9 if unknown
+ */
+static int rendition_width(int height, int source_width, int source_height) {
+    int64_t width = source_width > 0 && source_height > 0
+        ? (int64_t)source_width * height / source_height
+        : (int64_t)height * 16 / 9;
+    return (int)(width + 1) & ~1;
+}
+
+// What the master playlist and the transcoder need to know about a stream
+typedef struct {
+    int width;                      // Configured size, 0 if unknown
+    int height;
+    bool hevc;                      // Offered as H.264 too (transcode_hevc)
+    int heights[ABR_MAX_VARIANTS];  // Transcoded variants, highest first
+    int count;
+} abr_variants_t;
+
+/**
+ * Get the transcoded variants of a stream: the H.264 version of an HEVC
+ * stream at its own height, then the configured renditions below it
+ */
+static void get_variants(const char *stream_name, abr_variants_t *variants) {
+    memset(variants, 0, sizeof(*variants));
+
+    stream_handle_t handle = get_stream_by_name(stream_name);
+    stream_config_t config;
+    if (handle && get_stream_config(handle, &config) == 0) {
+        variants->width = config.width;
+        variants->height = config.height;
+        variants->hevc = g_config.transcode_hevc && config.height > 0 &&
+                         (strcasecmp(config.codec, "h265") == 0 || strcasecmp(config.codec, "hevc") == 0);
+    }
+
+    if (variants->hevc) {
+        variants->heights[variants->count++] = variants->height;
+    }
+
+    int heights[HLS_ABR_MAX_RENDITIONS];
+    int count = hls_abr_get_renditions(heights, HLS_ABR_MAX_RENDITIONS);
+    for (int i = 0; i < count; i++) {
+        if (variants->height <= 0 || heights[i] < variants->height) {
+            variants->heights[variants->count++] = heights[i];
+        }
+    }
+}
+
+/**
+ * Check whether a stream has a variant of a height
+ */
+static bool variant_available(const char *stream_name, int height) {
+    abr_variants_t variants;
+    get_variants(stream_name, &variants);
+    for (int i = 0; i < variants.count; i++) {
+        if (variants.heights[i] == height) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Find the transcoder of a stream
+ * Must be called with abr_mutex held.
+ */
+static abr_transcoder_t *find_transcoder(const char *stream_name) {
+    for (int i = 0; i < MAX_STREAMS; i++) {
+        if (transcoders[i] && strcmp(transcoders[i]->stream_name, stream_name) == 0) {
+            return transcoders[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Get the directory of a rendition
+ */
+static void get_rendition_dir(const char *stream_name, int height, char *dir, size_t size) {
+    const char *base = g_config.storage_path_hls[0] != '\0' ? g_config.storage_path_hls : g_config.storage_path;
+    snprintf(dir, size, "%s/hls/%s/%dp", base, stream_name, height);
+}
+
+/**
+ * Delete the files of a rendition and its directory
+ */
+static void remove_rendition_dir(const char *dir) {
+    DIR *d = opendir(dir);
+    if (!d) {
+        return;
+    }
+
+    struct dirent *entry;
+    char path[MAX_PATH_LENGTH * 2];
+    while ((entry = readdir(d)) != NULL) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+        if (unlink(path) != 0 && errno != ENOENT) {
+            log_warn("Failed to delete %s: %s", path, strerror(errno));
+        }
+    }
+    closedir(d);
+
+    if (rmdir(dir) != 0 && errno != ENOENT) {
+        log_warn("Failed to delete rendition directory %s: %s", dir, strerror(errno));
+    }
+}
+
+/**
+ * Stop writing a rendition and delete its files
+ */
+static void close_rendition(abr_transcoder_t *t, abr_rendition_t *r) {
+    if (r->muxer) {
+        av_write_trailer(r->muxer);
+        avformat_free_context(r->muxer);
+        r->muxer = NULL;
+        log_info("[Stream %s] Stopped %dp rendition", t->stream_name, r->height);
+    }
+
+    transcode_encoder_close(&r->encoder);
+    sws_freeContext(r->sws_ctx);
+    r->sws_ctx = NULL;
+    av_frame_free(&r->scaled);
+
+    if (r->dir[0] != '\0') {
+        remove_rendition_dir(r->dir);
+        r->dir[0] = '\0';
+    }
+}
+
+/**
+ * Start writing a rendition from frames of the given size
+ *
+ * @return 0 on success, -1 on error
+ */
+static int open_rendition(abr_transcoder_t *t, abr_rendition_t *r, const AVFrame *src,
+                          AVRational time_base, AVRational frame_rate) {
+    if (r->height > src->height) {
+        log_warn("[Stream %s] Skipping %dp rendition of a %dp stream", t->stream_name, r->height, src->height);
+        return -1;
+    }
+
+    int width = rendition_width(r->height, src->width, src->height);
+    int fps = frame_rate.num > 0 && frame_rate.den > 0 ? (int)(av_q2d(frame_rate) + 0.5) : 15;
+    if (fps <= 0) {
+        fps = 15;
+    }
+
+    if (transcode_encoder_open(&r->encoder, width, r->height, time_base, frame_rate,
+                               transcode_bit_rate(r->height), fps * ABR_SEGMENT_SECONDS, false) != 0) {
+        return -1;
+    }
+
+    r->scaled = av_frame_alloc();
+    if (!r->scaled) {
+        close_rendition(t, r);
+        return -1;
+    }
+    r->scaled->format = r->encoder.sw_format;
+    r->scaled->width = width;
+    r->scaled->height = r->height;
+    if (av_frame_get_buffer(r->scaled, 0) < 0) {
+        log_error("[Stream %s] Failed to allocate %dp frame", t->stream_name, r->height);
+        close_rendition(t, r);
+        return -1;
+    }
+
+    // Leftovers of an earlier run would be served as if the rendition were ready
+    get_rendition_dir(t->stream_name, r->height, r->dir, sizeof(r->dir));
+    remove_rendition_dir(r->dir);
+    if (mkdir(r->dir, 0755) != 0 && errno != EEXIST) {
+        log_error("[Stream %s] Failed to create %s: %s", t->stream_name, r->dir, strerror(errno));
+        close_rendition(t, r);
+        return -1;
+    }
+
+    char playlist[MAX_PATH_LENGTH + 16];
+    char segment_pattern[MAX_PATH_LENGTH + 16];
+    snprintf(playlist, sizeof(playlist), "%s/index.m3u8", r->dir);
+    snprintf(segment_pattern, sizeof(segment_pattern), "%s/segment_%%d.ts", r->dir);
+
+    int ret = avformat_alloc_output_context2(&r->muxer, NULL, "hls", playlist);
+    if (ret < 0 || !r->muxer) {
+        log_ffmpeg_error(ret, "Failed to create rendition muxer");
+        close_rendition(t, r);
+        return -1;
+    }
+
+    AVStream *stream = avformat_new_stream(r->muxer, NULL);
+    if (!stream || avcodec_parameters_from_context(stream->codecpar, r->encoder.codec_ctx) < 0) {
+        log_error("[Stream %s] Failed to set up %dp rendition stream", t->stream_name, r->height);
+        close_rendition(t, r);
+        return -1;
+    }
+    stream->time_base = r->encoder.codec_ctx->time_base;
+
+    AVDictionary *options = NULL;
+    av_dict_set_int(&options, "hls_time", ABR_SEGMENT_SECONDS, 0);
+    av_dict_set_int(&options, "hls_list_size", ABR_PLAYLIST_SIZE, 0);
+    av_dict_set(&options, "hls_segment_type", "mpegts", 0);
+    av_dict_set(&options, "hls_flags", "delete_segments+independent_segments", 0);
+    av_dict_set(&options, "hls_segment_filename", segment_pattern, 0);
+    av_dict_set(&options, "start_number", "0", 0);
+
+    ret = avformat_write_header(r->muxer, &options);
+    av_dict_free(&options);
+    if (ret < 0) {
+        log_ffmpeg_error(ret, "Failed to start rendition playlist");
+        // The header was not written, so there is no trailer to write
+        avformat_free_context(r->muxer);
+        r->muxer = NULL;
+        close_rendition(t, r);
+        return -1;
+    }
+
+    r->last_pts = AV_NOPTS_VALUE;
+    log_info("[Stream %s] Writing %dx%d rendition at %lld kbit/s (%s encoder %s)", t->stream_name,
+            width, r->height, (long long)(transcode_bit_rate(r->height) / 1000),
+            r->encoder.hardware ? "hardware" : "software", r->encoder.codec_ctx->codec->name);
+    return 0;
+}
+
+/**
+ * Write the packets an encoder has ready to the rendition's playlist
+ *
+ * @return 0 on success, negative AVERROR on error
+ */
+static int write_encoded_packets(abr_rendition_t *r, AVPacket *pkt) {
+    AVCodecContext *codec_ctx = r->encoder.codec_ctx;
+    AVStream *stream = r->muxer->streams[0];
+
+    int ret;
+    while ((ret = avcodec_receive_packet(codec_ctx, pkt)) == 0) {
+        pkt->stream_index = 0;
+        av_packet_rescale_ts(pkt, codec_ctx->time_base, stream->time_base);
+        ret = av_interleaved_write_frame(r->muxer, pkt);
+        if (ret < 0) {
+            av_packet_unref(pkt);
+            return ret;
+        }
+    }
+    return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF ? 0 : ret;
+}
+
+/**
+ * Scale and encode one decoded frame into a rendition
+ *
+ * @return 0 on success, -1 on error
+ */
+static int write_rendition_frame(abr_rendition_t *r, const AVFrame *src, AVPacket *pkt) {
+    // The encoder needs increasing timestamps; the GOP a consumer starts with can overlap
+    int64_t pts = src->best_effort_timestamp != AV_NOPTS_VALUE ? src->best_effort_timestamp : src->pts;
+    if (pts == AV_NOPTS_VALUE || (r->last_pts != AV_NOPTS_VALUE && pts <= r->last_pts)) {
+        return 0;
+    }
+
+    r->sws_ctx = sws_getCachedContext(r->sws_ctx, src->width, src->height, src->format,
+                                      r->scaled->width, r->scaled->height, r->scaled->format,
+                                      SWS_BILINEAR, NULL, NULL, NULL);
+    if (!r->sws_ctx || av_frame_make_writable(r->scaled) < 0) {
+        return -1;
+    }
+
+    sws_scale(r->sws_ctx, (const uint8_t * const *)src->data, src->linesize, 0, src->height,
+              r->scaled->data, r->scaled->linesize);
+    r->scaled->pts = pts;
+    r->last_pts = pts;
+
+    int ret = transcode_encoder_send_frame(&r->encoder, r->scaled);
+    if (ret < 0 && ret != AVERROR(EAGAIN)) {
+        log_ffmpeg_error(ret, "Failed to encode rendition frame");
+        return -1;
+    }
+
+    ret = write_encoded_packets(r, pkt);
+    if (ret < 0) {
+        log_ffmpeg_error(ret, "Failed to write rendition segment");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Write a decoded frame to every rendition that is watched, stopping the
+ * ones that no longer are
+ */
+static void write_renditions(abr_transcoder_t *t, const AVFrame *src, AVRational time_base,
+                             AVRational frame_rate, AVPacket *pkt) {
+    int64_t idle_us = (int64_t)g_config.hls_idle_timeout * 1000000;
+    int64_t now = av_gettime_relative();
+
+    for (int i = 0; i < t->rendition_count; i++) {
+        abr_rendition_t *r = &t->renditions[i];
+
+        pthread_mutex_lock(&abr_mutex);
+        bool watched = r->requested_us > 0 && now - r->requested_us < idle_us;
+        pthread_mutex_unlock(&abr_mutex);
+
+        if (!watched) {
+            if (r->muxer) {
+                close_rendition(t, r);
+            }
+            r->failed = false;
+            continue;
+        }
+
+        if (r->failed) {
+            continue;
+        }
+
+        if (!r->muxer && open_rendition(t, r, src, time_base, frame_rate) != 0) {
+            r->failed = true;
+            continue;
+        }
+
+        if (write_rendition_frame(r, src, pkt) != 0) {
+            log_error("[Stream %s] Stopping %dp rendition after an error", t->stream_name, r->height);
+            close_rendition(t, r);
+            r->failed = true;
+        }
+    }
+}
+
+/**
+ * Check whether any rendition of a transcoder is watched, marking the
+ * transcoder as leaving otherwise
+ */
+static bool transcoder_wanted(abr_transcoder_t *t) {
+    int64_t idle_us = (int64_t)g_config.hls_idle_timeout * 1000000;
+    int64_t now = av_gettime_relative();
+
+    pthread_mutex_lock(&abr_mutex);
+    bool wanted = false;
+    for (int i = 0; i < t->rendition_count; i++) {
+        if (t->renditions[i].requested_us > 0 && now - t->renditions[i].requested_us < idle_us) {
+            wanted = true;
+            break;
+        }
+    }
+    if (!wanted) {
+        atomic_store(&t->running, 0);
+    }
+    pthread_mutex_unlock(&abr_mutex);
+    return wanted;
+}
+
+/**
+ * Open the decoder of the consumer's video stream
+ *
+ * @return Decoder context or NULL on failure
+ */
+static AVCodecContext *open_decoder(abr_transcoder_t *t, stream_ingest_consumer_t *consumer,
+                                    int *video_stream_idx, AVRational *time_base, AVRational *frame_rate) {
+    AVFormatContext *fmt_ctx = stream_ingest_get_format_context(consumer);
+    int idx = stream_ingest_get_video_stream_index(consumer);
+    if (!fmt_ctx || idx < 0 || idx >= (int)fmt_ctx->nb_streams) {
+        log_error("[Stream %s] No video stream available for transcoding", t->stream_name);
+        return NULL;
+    }
+
+    const AVStream *stream = fmt_ctx->streams[idx];
+    const AVCodec *codec = hw_decode_find_decoder(stream->codecpar->codec_id);
+    if (!codec) {
+        log_error("[Stream %s] No decoder for codec %s", t->stream_name,
+                 avcodec_get_name(stream->codecpar->codec_id));
+        return NULL;
+    }
+
+    AVCodecContext *codec_ctx = avcodec_alloc_context3(codec);
+    if (!codec_ctx || avcodec_parameters_to_context(codec_ctx, stream->codecpar) < 0) {
+        log_error("[Stream %s] Failed to set up transcoding decoder", t->stream_name);
+        avcodec_free_context(&codec_ctx);
+        return NULL;
+    }
+
+    codec_ctx->pkt_timebase = stream->time_base;
+    bool hw_decoding = hw_decode_setup(codec_ctx) == 0;
+
+    int ret = avcodec_open2(codec_ctx, codec, NULL);
+    if (ret < 0) {
+        log_ffmpeg_error(ret, "Failed to open transcoding decoder");
+        avcodec_free_context(&codec_ctx);
+        return NULL;
+    }
+
+    log_info("[Stream %s] Transcoding decoder %s opened (%s)", t->stream_name, codec->name,
+            hw_decoding ? hw_decode_backend_name() : "software");
+
+    *video_stream_idx = idx;
+    *time_base = stream->time_base;
+    *frame_rate = stream->avg_frame_rate.num > 0 ? stream->avg_frame_rate : stream->r_frame_rate;
+    return codec_ctx;
+}
+
+/**
+ * Transcoder thread of a stream
+ * Decodes the stream's video once for all renditions, until none is watched.
+ */
+static void *abr_transcoder_thread(void *arg) {
+    abr_transcoder_t *t = (abr_transcoder_t *)arg;
+    thread_set_identity(THREAD_CLASS_HLS, "abr", t->stream_name);
+
+    stream_ingest_consumer_t *consumer = stream_ingest_attach_with_gop(t->stream_name, t->url, t->protocol,
+                                                                       "abr", 0, true);
+    AVPacket *pkt = av_packet_alloc();
+    AVPacket *out_pkt = av_packet_alloc();
+    AVFrame *frame = av_frame_alloc();
+    AVFrame *sw_frame = av_frame_alloc();
+    if (!consumer || !pkt || !out_pkt || !frame || !sw_frame) {
+        log_error("[Stream %s] Failed to start transcoding", t->stream_name);
+        atomic_store(&t->running, 0);
+    } else {
+        log_info("[Stream %s] Transcoding HLS renditions from shared ingest", t->stream_name);
+    }
+
+    AVCodecContext *decoder = NULL;
+    AVRational time_base = {1, 90000};
+    AVRational frame_rate = {0, 1};
+    int video_stream_idx = -1;
+    bool decoder_synced = false;
+
+    while (atomic_load(&t->running) && !is_shutdown_initiated() && transcoder_wanted(t)) {
+        if (!decoder) {
+            int ret = stream_ingest_wait_for_streams(consumer, 1000);
+            if (ret == AVERROR_EOF) {
+                break;
+            }
+            if (ret != 0) {
+                continue;
+            }
+
+            decoder = open_decoder(t, consumer, &video_stream_idx, &time_base, &frame_rate);
+            if (!decoder) {
+                usleep(1000000);
+                continue;
+            }
+            decoder_synced = false;
+        }
+
+        int ret = stream_ingest_read_packet(consumer, pkt, 500);
+        if (ret == AVERROR(EAGAIN)) {
+            continue;
+        }
+        if (ret == STREAM_INGEST_STREAMS_CHANGED) {
+            // The renditions restart with the new stream's timestamps and size
+            log_info("[Stream %s] Input streams changed, restarting transcoding", t->stream_name);
+            avcodec_free_context(&decoder);
+            for (int i = 0; i < t->rendition_count; i++) {
+                close_rendition(t, &t->renditions[i]);
+            }
+            continue;
+        }
+        if (ret < 0) {
+            break;
+        }
+
+        if (pkt->stream_index != video_stream_idx ||
+            (!decoder_synced && !(pkt->flags & AV_PKT_FLAG_KEY))) {
+            av_packet_unref(pkt);
+            continue;
+        }
+        decoder_synced = true;
+
+        if (avcodec_send_packet(decoder, pkt) == 0) {
+            while (avcodec_receive_frame(decoder, frame) == 0) {
+                const AVFrame *src = hw_decode_get_sw_frame(frame, sw_frame);
+                if (src) {
+                    write_renditions(t, src, time_base, frame_rate, out_pkt);
+                }
+                av_frame_unref(frame);
+            }
+        }
+        av_packet_unref(pkt);
+    }
+
+    atomic_store(&t->running, 0);
+
+    for (int i = 0; i < t->rendition_count; i++) {
+        close_rendition(t, &t->renditions[i]);
+    }
+    avcodec_free_context(&decoder);
+    av_frame_free(&sw_frame);
+    av_frame_free(&frame);
+    av_packet_free(&out_pkt);
+    av_packet_free(&pkt);
+    if (consumer) {
+        stream_ingest_detach(consumer);
+    }
+
+    log_info("[Stream %s] Transcoding of HLS renditions stopped", t->stream_name);
+
+    pthread_mutex_lock(&abr_mutex);
+    for (int i = 0; i < MAX_STREAMS; i++) {
+        if (transcoders[i] == t) {
+            transcoders[i] = NULL;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&abr_mutex);
+
+    free(t);
+    return NULL;
+}
+
+/**
+ * Create and start the transcoder of a stream
+ * Must be called with abr_mutex held.
+ */
+static abr_transcoder_t *start_transcoder(const char *stream_name, const char *url, int protocol) {
+    int slot = -1;
+    for (int i = 0; i < MAX_STREAMS; i++) {
+        if (!transcoders[i]) {
+            slot = i;
+            break;
+        }
+    }
+    if (slot < 0) {
+        log_error("No free transcoder slot for stream %s", stream_name);
+        return NULL;
+    }
+
+    abr_transcoder_t *t = calloc(1, sizeof(abr_transcoder_t));
+    if (!t) {
+        log_error("Failed to allocate transcoder for stream %s", stream_name);
+        return NULL;
+    }
+
+    strncpy(t->stream_name, stream_name, MAX_STREAM_NAME - 1);
+    strncpy(t->url, url, MAX_URL_LENGTH - 1);
+    t->protocol = protocol;
+    atomic_init(&t->running, 1);
+
+    abr_variants_t variants;
+    get_variants(stream_name, &variants);
+    t->rendition_count = variants.count;
+    for (int i = 0; i < variants.count; i++) {
+        t->renditions[i].height = variants.heights[i];
+        t->renditions[i].last_pts = AV_NOPTS_VALUE;
+    }
+
+    pthread_t thread;
+    if (pthread_create_with_stack(&thread, abr_transcoder_thread, t, STREAM_THREAD_STACK_SIZE, true) != 0) {
+        log_error("Failed to create transcoder thread for stream %s", stream_name);
+        free(t);
+        return NULL;
+    }
+
+    transcoders[slot] = t;
+    return t;
+}
+
+int hls_abr_get_renditions(int *heights, int max) {
+    if (!heights || max <= 0) {
+        return 0;
+    }
+
+    char list[sizeof(g_config.hls_abr_renditions)];
+    strncpy(list, g_config.hls_abr_renditions, sizeof(list) - 1);
+    list[sizeof(list) - 1] = '\0';
+
+    int count = 0;
+    char *saveptr = NULL;
+    for (char *token = strtok_r(list, ", ", &saveptr); token && count < max;
+         token = strtok_r(NULL, ", ", &saveptr)) {
+        // "720" and "720p" both name a height
+        int height = atoi(token);
+        if (height < ABR_MIN_HEIGHT || height > ABR_MAX_HEIGHT) {
+            continue;
+        }
+
+        // Insert highest first, skipping duplicates
+        int pos = 0;
+        while (pos < count && heights[pos] > height) {
+            pos++;
+        }
+        if (pos < count && heights[pos] == height) {
+            continue;
+        }
+        memmove(&heights[pos + 1], &heights[pos], (size_t)(count - pos) * sizeof(int));
+        heights[pos] = height;
+        count++;
+    }
+
+    return count;
+}
+
+const char *hls_abr_parse_path(const char *file_name, int *height) {
+    if (!file_name || !isdigit((unsigned char)file_name[0])) {
+        return NULL;
+    }
+
+    char *end = NULL;
+    long value = strtol(file_name, &end, 10);
+    if (!end || end[0] != 'p' || end[1] != '/' || value < ABR_MIN_HEIGHT || value > ABR_MAX_HEIGHT) {
+        return NULL;
+    }
+
+    // Only files directly in the rendition directory
+    const char *name = end + 2;
+    if (name[0] == '\0' || name[0] == '.' || strchr(name, '/') || strchr(name, '\\')) {
+        return NULL;
+    }
+
+    if (height) {
+        *height = (int)value;
+    }
+    return name;
+}
+
+int hls_abr_request(const char *stream_name, int height) {
+    if (!stream_name || stream_name[0] == '\0' || !stream_ingest_enabled() ||
+        !variant_available(stream_name, height)) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&abr_mutex);
+    abr_transcoder_t *t = find_transcoder(stream_name);
+    pthread_mutex_unlock(&abr_mutex);
+
+    char url[MAX_URL_LENGTH] = {0};
+    int protocol = STREAM_PROTOCOL_TCP;
+    if (!t && get_hls_stream_input(stream_name, url, sizeof(url), &protocol) != 0) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&abr_mutex);
+
+    t = find_transcoder(stream_name);
+    if (!t) {
+        t = start_transcoder(stream_name, url, protocol);
+        if (!t) {
+            pthread_mutex_unlock(&abr_mutex);
+            return -1;
+        }
+    } else if (!atomic_load(&t->running)) {
+        // Leaving transcoder; the next request starts a new one
+        pthread_mutex_unlock(&abr_mutex);
+        return 1;
+    }
+
+    int result = -1;
+    for (int i = 0; i < t->rendition_count; i++) {
+        if (t->renditions[i].height == height) {
+            t->renditions[i].requested_us = av_gettime_relative();
+            result = 0;
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&abr_mutex);
+    return result;
+}
+
+/**
+ * Get the CODECS attribute of a variant, for players to leave out the ones they cannot play
+ */
+static const char *variant_codecs(bool hevc, int height) {
+    if (hevc) {
+        return height > 1080 ? "hvc1.1.6.L150.90" : height > 720 ? "hvc1.1.6.L120.90" : "hvc1.1.6.L93.90";
+    }
+    return height > 1080 ? "avc1.640033" : height > 720 ? "avc1.640028" : "avc1.64001f";
+}
+
+int hls_abr_build_master_playlist(const char *stream_name, char *buf, size_t size) {
+    if (!stream_name || !buf || size == 0) {
+        return -1;
+    }
+
+    abr_variants_t variants;
+    get_variants(stream_name, &variants);
+
+    // The stream's own playlist comes first, players start with it; cameras
+    // usually stream at about twice the rate of a transcode of their size
+    int len = snprintf(buf, size, "#EXTM3U\n#EXT-X-VERSION:3\n");
+    if (variants.hevc) {
+        // Browsers without HEVC drop this variant for the H.264 version that follows
+        len += snprintf(buf + len, size - (size_t)len,
+                        "#EXT-X-STREAM-INF:BANDWIDTH=%lld,RESOLUTION=%dx%d,CODECS=\"%s\"\n"
+                        "index.m3u8\n",
+                        (long long)transcode_bit_rate(variants.height) * 2,
+                        rendition_width(variants.height, variants.width, variants.height),
+                        variants.height, variant_codecs(true, variants.height));
+    } else if (variants.width > 0 && variants.height > 0) {
+        len += snprintf(buf + len, size - (size_t)len,
+                        "#EXT-X-STREAM-INF:BANDWIDTH=%lld,RESOLUTION=%dx%d\n"
+                        "index.m3u8\n",
+                        (long long)transcode_bit_rate(variants.height) * 2, variants.width, variants.height);
+    } else {
+        len += snprintf(buf + len, size - (size_t)len,
+                        "#EXT-X-STREAM-INF:BANDWIDTH=%lld\n"
+                        "index.m3u8\n",
+                        (long long)transcode_bit_rate(1080) * 2);
+    }
+
+    for (int i = 0; i < variants.count && len >= 0 && (size_t)len < size; i++) {
+        int height = variants.heights[i];
+        len += snprintf(buf + len, size - (size_t)len,
+                        "#EXT-X-STREAM-INF:BANDWIDTH=%lld,RESOLUTION=%dx%d%s%s%s\n"
+                        "%dp/index.m3u8\n",
+                        (long long)transcode_bit_rate(height),
+                        rendition_width(height, variants.width, variants.height), height,
+                        variants.hevc ? ",CODECS=\"" : "", variants.hevc ? variant_codecs(false, height) : "",
+                        variants.hevc ? "\"" : "", height);
+    }
+
+    return len >= 0 && (size_t)len < size ? len : -1;
+}
+
+void hls_abr_stop(const char *stream_name) {
+    if (!stream_name) {
+        return;
+    }
+
+    pthread_mutex_lock(&abr_mutex);
+    abr_transcoder_t *t = find_transcoder(stream_name);
+    if (t) {
+        atomic_store(&t->running, 0);
+    }
+    pthread_mutex_unlock(&abr_mutex);
+
+    if (!t) {
+        return;
+    }
+
+    // The thread leaves its loop within one read timeout
+    for (int i = 0; i < 100; i++) {
+        usleep(50000);
+        pthread_mutex_lock(&abr_mutex);
+        bool stopped = find_transcoder(stream_name) == NULL;
+        pthread_mutex_unlock(&abr_mutex);
+        if (stopped) {
+            return;
+        }
+    }
+
+    log_warn("[Stream %s] Transcoding of HLS renditions did not stop in time", stream_name);
+}
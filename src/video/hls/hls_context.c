@@ -5,10 +5,10 @@
 #include "core/logger.h"
 #include "video/stream_state.h"
 #include "video/hls/hls_context.h"
+#include "video/stream_arena.h"
 
 // Forward declarations for memory management functions
 extern void mark_context_as_freed(void *ctx);
-extern void *safe_free(void *ptr);
 
 // Include the unified thread header
 #include "video/hls/hls_unified_thread.h"
@@ -221,9 +221,8 @@ void cleanup_hls_contexts(void) {
                 extern void mark_context_as_freed(void *ctx);
                 mark_context_as_freed(streaming_contexts[i]);
 
-                // CRITICAL FIX: Use safe_free to free the context
-                extern void *safe_free(void *ptr);
-                safe_free(streaming_contexts[i]);
+                // Return the context to the stream's arena
+                stream_arena_free(streaming_contexts[i]);
                 streaming_contexts[i] = NULL;
             }
         }
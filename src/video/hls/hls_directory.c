@@ -6,13 +6,210 @@
 #include <sys/stat.h>
 #include <time.h>
 #include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
 
 #include "core/logger.h"
 #include "core/config.h"
+#include "storage/deletion_worker.h"
 #include "video/streams.h"
+#include "video/thread_utils.h"
 #include "video/hls/hls_directory.h"
 #include "video/hls/hls_context.h"
 
+// Directory below the HLS base that stale stream directories are renamed into
+#define HLS_TRASH_DIR ".deleted"
+
+static struct {
+    pthread_t thread;
+    bool running;
+    bool work_queued;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+} cleanup_worker = {
+    .running = false,
+    .work_queued = false,
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER
+};
+
+/**
+ * Get the directory holding the HLS directories of all streams
+ */
+static int get_hls_base_dir(char *dir, size_t size) {
+    config_t *global_config = get_streaming_config();
+    if (!global_config) {
+        return -1;
+    }
+
+    // Use storage_path_hls if specified, otherwise fall back to storage_path
+    const char *base_storage_path = global_config->storage_path;
+    if (global_config->storage_path_hls[0] != '\0') {
+        base_storage_path = global_config->storage_path_hls;
+    }
+
+    int n = snprintf(dir, size, "%s/hls", base_storage_path);
+    return (n > 0 && (size_t)n < size) ? 0 : -1;
+}
+
+/**
+ * Rename a stream's HLS directory into the trash and wake the cleanup worker
+ * The rename is atomic, so nothing ever sees a half-emptied directory, and
+ * it stays on the same file system.
+ *
+ * @return 0 on success, -1 if the directory has to be emptied in place
+ */
+static int retire_hls_directory(const char *hls_base_dir, const char *stream_hls_dir, const char *name) {
+    static atomic_uint sequence;
+
+    char trash_dir[MAX_PATH_LENGTH];
+    snprintf(trash_dir, sizeof(trash_dir), "%s/%s", hls_base_dir, HLS_TRASH_DIR);
+    if (mkdir(trash_dir, 0755) != 0 && errno != EEXIST) {
+        log_warn("Failed to create HLS trash directory %s: %s", trash_dir, strerror(errno));
+        return -1;
+    }
+
+    char aside[MAX_PATH_LENGTH];
+    int n = snprintf(aside, sizeof(aside), "%s/%s.%ld.%u", trash_dir, name, (long)time(NULL),
+                     atomic_fetch_add(&sequence, 1));
+    if (n <= 0 || (size_t)n >= sizeof(aside)) {
+        return -1;
+    }
+    if (rename(stream_hls_dir, aside) != 0) {
+        log_warn("Failed to move HLS directory %s aside: %s", stream_hls_dir, strerror(errno));
+        return -1;
+    }
+
+    pthread_mutex_lock(&cleanup_worker.mutex);
+    cleanup_worker.work_queued = true;
+    pthread_cond_signal(&cleanup_worker.cond);
+    pthread_mutex_unlock(&cleanup_worker.mutex);
+    return 0;
+}
+
+/**
+ * Delete a directory and everything below it
+ * Stops early when the worker is stopped; the rest is deleted after the next start.
+ */
+static void remove_tree(const char *path) {
+    DIR *dir = opendir(path);
+    if (dir) {
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL && cleanup_worker.running) {
+            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+                continue;
+            }
+
+            char child[MAX_PATH_LENGTH];
+            snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+
+            struct stat st;
+            if (entry->d_type == DT_DIR ||
+                (entry->d_type == DT_UNKNOWN && lstat(child, &st) == 0 && S_ISDIR(st.st_mode))) {
+                remove_tree(child);
+            } else if (unlink(child) != 0 && errno != ENOENT) {
+                log_warn("Failed to remove stale HLS file %s: %s", child, strerror(errno));
+            }
+        }
+        closedir(dir);
+    }
+
+    if (rmdir(path) != 0 && errno != ENOENT && cleanup_worker.running) {
+        log_warn("Failed to remove stale HLS directory %s: %s", path, strerror(errno));
+    }
+}
+
+/**
+ * Delete everything in the trash
+ */
+static void empty_hls_trash(void) {
+    char hls_base_dir[MAX_PATH_LENGTH];
+    if (get_hls_base_dir(hls_base_dir, sizeof(hls_base_dir)) != 0) {
+        return;
+    }
+
+    char trash_dir[MAX_PATH_LENGTH];
+    snprintf(trash_dir, sizeof(trash_dir), "%s/%s", hls_base_dir, HLS_TRASH_DIR);
+
+    DIR *dir = opendir(trash_dir);
+    if (!dir) {
+        return;
+    }
+
+    int removed = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL && cleanup_worker.running) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        char path[MAX_PATH_LENGTH];
+        snprintf(path, sizeof(path), "%s/%s", trash_dir, entry->d_name);
+        remove_tree(path);
+        removed++;
+    }
+    closedir(dir);
+
+    if (removed > 0) {
+        log_info("Removed %d stale HLS directories", removed);
+    }
+}
+
+static void *cleanup_worker_thread(void *arg) {
+    (void)arg;
+    thread_set_identity(THREAD_CLASS_SERVICE, "hls-cleanup", NULL);
+    lower_thread_priority();
+
+    pthread_mutex_lock(&cleanup_worker.mutex);
+    while (cleanup_worker.running) {
+        cleanup_worker.work_queued = false;
+        pthread_mutex_unlock(&cleanup_worker.mutex);
+
+        empty_hls_trash();
+
+        pthread_mutex_lock(&cleanup_worker.mutex);
+        while (cleanup_worker.running && !cleanup_worker.work_queued) {
+            pthread_cond_wait(&cleanup_worker.cond, &cleanup_worker.mutex);
+        }
+    }
+    pthread_mutex_unlock(&cleanup_worker.mutex);
+
+    return NULL;
+}
+
+int start_hls_cleanup_worker(void) {
+    pthread_mutex_lock(&cleanup_worker.mutex);
+    if (cleanup_worker.running) {
+        pthread_mutex_unlock(&cleanup_worker.mutex);
+        return 0;
+    }
+    cleanup_worker.running = true;
+    cleanup_worker.work_queued = true;
+    pthread_mutex_unlock(&cleanup_worker.mutex);
+
+    if (pthread_create(&cleanup_worker.thread, NULL, cleanup_worker_thread, NULL) != 0) {
+        log_error("Failed to start HLS cleanup worker");
+        cleanup_worker.running = false;
+        return -1;
+    }
+
+    log_info("HLS cleanup worker started");
+    return 0;
+}
+
+void stop_hls_cleanup_worker(void) {
+    pthread_mutex_lock(&cleanup_worker.mutex);
+    if (!cleanup_worker.running) {
+        pthread_mutex_unlock(&cleanup_worker.mutex);
+        return;
+    }
+    cleanup_worker.running = false;
+    pthread_cond_signal(&cleanup_worker.cond);
+    pthread_mutex_unlock(&cleanup_worker.mutex);
+
+    pthread_join(cleanup_worker.thread, NULL);
+    log_info("HLS cleanup worker stopped");
+}
+
 /**
  * Ensure the HLS output directory exists and is writable
  */
@@ -211,6 +408,20 @@ int clear_stream_hls_segments(const char *stream_name) {
         return 0;
     }
 
+    // Swap in an empty directory and leave the old one to the cleanup worker
+    char hls_base_dir[MAX_PATH_LENGTH];
+    snprintf(hls_base_dir, sizeof(hls_base_dir), "%s/hls", base_storage_path);
+    if (retire_hls_directory(hls_base_dir, stream_hls_dir, stream_name) == 0) {
+        if (mkdir(stream_hls_dir, 0777) != 0 && errno != EEXIST) {
+            log_warn("Failed to recreate HLS directory %s: %s", stream_hls_dir, strerror(errno));
+        } else if (chmod(stream_hls_dir, 0777) != 0) {
+            log_warn("Failed to set permissions on directory: %s (error: %s)",
+                    stream_hls_dir, strerror(errno));
+        }
+        log_info("Cleared HLS segments for stream %s", stream_name);
+        return 0;
+    }
+
     log_info("Clearing HLS segments for stream: %s in directory: %s", stream_name, stream_hls_dir);
 
     // Remove all .ts segment files using direct C functions
@@ -358,8 +569,8 @@ void cleanup_hls_directories(void) {
     // Iterate through each stream directory
     struct dirent *entry;
     while ((entry = readdir(dir)) != NULL) {
-        // Skip . and .. directories
-        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+        // Skip . and .., the trash and other hidden entries
+        if (entry->d_name[0] == '.') {
             continue;
         }
 
@@ -492,6 +703,10 @@ void cleanup_hls_directories(void) {
                 }
 
                 log_info("Cleaned up temporary files for active stream: %s", entry->d_name);
+            } else if (retire_hls_directory(hls_base_dir, stream_hls_dir, entry->d_name) == 0) {
+                // Deleted by the cleanup worker, or after the next start if it is stopping
+                log_info("Stream %s is inactive, moved its HLS directory aside", entry->d_name);
+                continue;
             } else {
                 // For inactive streams, we can safely remove all files
                 log_info("Stream %s is inactive, removing all HLS files", entry->d_name);
@@ -0,0 +1,703 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#include <libavformat/avformat.h>
+#include <libavutil/opt.h>
+
+#include "core/logger.h"
+#include "core/config.h"
+#include "utils/memory.h"
+#include "video/packet_pool.h"
+#include "video/stream_registry.h"
+#include "video/hls/hls_ll_packager.h"
+
+// Segments kept per stream, including the one receiving parts
+#define HLS_LL_SEGMENT_COUNT 4
+
+// Most parts per segment; a longer GOP extends the last part instead
+#define HLS_LL_MAX_PARTS 64
+
+// Size of the generated playlist buffer
+#define HLS_LL_PLAYLIST_SIZE 16384
+
+typedef struct {
+    int64_t sequence;           // Number of the part across segments, used in its URI
+    double duration;            // In seconds
+    bool independent;           // Starts with a keyframe
+    AVBufferRef *data;
+} ll_part_t;
+
+typedef struct {
+    int64_t msn;
+    double duration;            // In seconds, once complete
+    int part_count;
+    bool parts_listed;          // Parts are still listed in the playlist
+    ll_part_t parts[HLS_LL_MAX_PARTS];
+    AVBufferRef *data;          // Concatenated parts, once complete
+} ll_segment_t;
+
+/**
+ * Published state of one stream
+ * Indexed by stream registry ID; an active entry holds a reference on its ID.
+ * Only the last complete segment keeps its parts, which is more than the
+ * three part targets the playlist has to cover.
+ */
+typedef struct {
+    bool active;
+    const hls_ll_packager_t *owner;
+    int stream_id;
+    char stream_name[MAX_STREAM_NAME];
+    AVBufferRef *init;
+    ll_segment_t segments[HLS_LL_SEGMENT_COUNT];  // Ring indexed by msn
+    int64_t first_msn;          // Oldest complete segment
+    int64_t current_msn;        // Segment receiving parts
+    int64_t next_part;          // Number of the next part to be published
+    double part_target;         // In seconds
+    int target_duration;        // In seconds, only ever grows
+} ll_stream_t;
+
+struct hls_ll_packager {
+    char stream_name[MAX_STREAM_NAME];
+    AVFormatContext *ctx;
+    packet_pool_t *packet_pool;
+    AVRational time_base;       // Time base of the muxer
+    int64_t part_target;        // In the muxer time base
+    int64_t segment_target;
+    int64_t part_start;         // DTS of the first packet of the current part
+    int64_t segment_start;
+    int64_t last_dts;
+    bool part_independent;
+    bool started;               // The first keyframe has been written
+};
+
+static ll_stream_t *ll_streams[MAX_STREAMS];
+static pthread_mutex_t ll_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void tracked_free(void *opaque, uint8_t *data) {
+    memory_track(MEMORY_TAG_HLS, (size_t)(uintptr_t)opaque, false);
+    av_free(data);
+}
+
+/**
+ * Take over data from av_malloc() as a buffer counted in the HLS memory usage
+ * The data is freed on failure.
+ */
+static AVBufferRef *tracked_buffer(uint8_t *data, int size) {
+    AVBufferRef *buf = av_buffer_create(data, size, tracked_free, (void *)(uintptr_t)size, 0);
+    if (!buf) {
+        av_free(data);
+        return NULL;
+    }
+    memory_track(MEMORY_TAG_HLS, (size_t)size, true);
+    return buf;
+}
+
+/**
+ * Find the published state of a stream
+ * Must be called with ll_mutex held.
+ */
+static ll_stream_t *find_stream(const char *stream_name) {
+    if (!stream_name || stream_name[0] == '\0') {
+        return NULL;
+    }
+
+    int id = stream_registry_lookup(stream_name);
+    if (id < 0 || id >= MAX_STREAMS) {
+        return NULL;
+    }
+
+    ll_stream_t *state = ll_streams[id];
+    if (!state || !state->active || strcmp(state->stream_name, stream_name) != 0) {
+        return NULL;
+    }
+    return state;
+}
+
+/**
+ * Drop the parts of a segment
+ */
+static void clear_parts(ll_segment_t *segment) {
+    for (int i = 0; i < segment->part_count; i++) {
+        av_buffer_unref(&segment->parts[i].data);
+    }
+    segment->part_count = 0;
+    segment->parts_listed = false;
+}
+
+/**
+ * Drop a segment and its parts
+ */
+static void clear_segment(ll_segment_t *segment) {
+    clear_parts(segment);
+    av_buffer_unref(&segment->data);
+    segment->duration = 0;
+}
+
+/**
+ * Drop everything published for a stream
+ * Must be called with ll_mutex held.
+ */
+static void clear_stream(ll_stream_t *state) {
+    for (int i = 0; i < HLS_LL_SEGMENT_COUNT; i++) {
+        clear_segment(&state->segments[i]);
+    }
+    av_buffer_unref(&state->init);
+}
+
+/**
+ * Start publishing a stream
+ */
+static int publish_open(hls_ll_packager_t *packager, AVBufferRef *init, double part_target, int target_duration) {
+    int id = stream_registry_acquire(packager->stream_name);
+    if (id == STREAM_ID_INVALID || id >= MAX_STREAMS) {
+        stream_registry_release(id);
+        return -1;
+    }
+
+    pthread_mutex_lock(&ll_mutex);
+
+    ll_stream_t *state = ll_streams[id];
+    if (!state) {
+        state = calloc(1, sizeof(ll_stream_t));
+        if (!state) {
+            pthread_mutex_unlock(&ll_mutex);
+            stream_registry_release(id);
+            return -1;
+        }
+        ll_streams[id] = state;
+    }
+
+    // A previous packager that was never destroyed already holds the ID
+    bool replaced = state->active;
+
+    clear_stream(state);
+    state->active = true;
+    state->owner = packager;
+    state->stream_id = id;
+    strncpy(state->stream_name, packager->stream_name, MAX_STREAM_NAME - 1);
+    state->stream_name[MAX_STREAM_NAME - 1] = '\0';
+    state->init = init;
+    state->first_msn = 0;
+    state->current_msn = 0;
+    state->next_part = 0;
+    state->part_target = part_target;
+    state->target_duration = target_duration;
+    state->segments[0].msn = 0;
+    state->segments[0].parts_listed = true;
+
+    pthread_mutex_unlock(&ll_mutex);
+
+    if (replaced) {
+        stream_registry_release(id);
+    }
+    return 0;
+}
+
+/**
+ * Stop publishing a stream
+ */
+static void publish_close(hls_ll_packager_t *packager) {
+    pthread_mutex_lock(&ll_mutex);
+
+    ll_stream_t *state = find_stream(packager->stream_name);
+    if (!state || state->owner != packager) {
+        pthread_mutex_unlock(&ll_mutex);
+        return;
+    }
+
+    int id = state->stream_id;
+    clear_stream(state);
+    state->active = false;
+    state->owner = NULL;
+
+    pthread_mutex_unlock(&ll_mutex);
+    stream_registry_release(id);
+}
+
+/**
+ * Publish a part, optionally completing the segment it belongs to
+ * Takes over the reference to data.
+ */
+static void publish_part(hls_ll_packager_t *packager, AVBufferRef *data, double duration, bool independent,
+                         bool completes_segment, double segment_duration) {
+    pthread_mutex_lock(&ll_mutex);
+
+    ll_stream_t *state = find_stream(packager->stream_name);
+    if (!state || state->owner != packager) {
+        pthread_mutex_unlock(&ll_mutex);
+        av_buffer_unref(&data);
+        return;
+    }
+
+    ll_segment_t *segment = &state->segments[state->current_msn % HLS_LL_SEGMENT_COUNT];
+    if (data && segment->part_count < HLS_LL_MAX_PARTS) {
+        ll_part_t *part = &segment->parts[segment->part_count++];
+        part->sequence = state->next_part++;
+        part->duration = duration;
+        part->independent = independent;
+        part->data = data;
+        data = NULL;
+    }
+    av_buffer_unref(&data);
+
+    if (completes_segment && segment->part_count > 0) {
+        // The segment is served as one resource made of its parts
+        size_t size = 0;
+        for (int i = 0; i < segment->part_count; i++) {
+            size += segment->parts[i].data->size;
+        }
+
+        uint8_t *segment_data = av_malloc(size);
+        segment->data = segment_data ? tracked_buffer(segment_data, (int)size) : NULL;
+        if (segment->data) {
+            size_t offset = 0;
+            for (int i = 0; i < segment->part_count; i++) {
+                memcpy(segment->data->data + offset, segment->parts[i].data->data, segment->parts[i].data->size);
+                offset += segment->parts[i].data->size;
+            }
+        } else {
+            log_warn("Failed to allocate LL-HLS segment %lld of stream %s",
+                    (long long)segment->msn, state->stream_name);
+        }
+        segment->duration = segment_duration;
+
+        int rounded = (int)ceil(segment_duration);
+        if (rounded > state->target_duration) {
+            state->target_duration = rounded;
+        }
+
+        // Only the newest complete segment keeps its parts
+        if (state->current_msn > state->first_msn) {
+            clear_parts(&state->segments[(state->current_msn - 1) % HLS_LL_SEGMENT_COUNT]);
+        }
+
+        state->current_msn++;
+        if (state->current_msn - state->first_msn >= HLS_LL_SEGMENT_COUNT) {
+            state->first_msn = state->current_msn - HLS_LL_SEGMENT_COUNT + 1;
+        }
+
+        ll_segment_t *next = &state->segments[state->current_msn % HLS_LL_SEGMENT_COUNT];
+        clear_segment(next);
+        next->msn = state->current_msn;
+        next->parts_listed = true;
+    }
+
+    pthread_mutex_unlock(&ll_mutex);
+}
+
+/**
+ * Close the fragment being muxed and start a new one
+ * The fragment written since the last call becomes a part.
+ */
+static int finish_part(hls_ll_packager_t *packager, int64_t end_dts, bool completes_segment) {
+    AVFormatContext *ctx = packager->ctx;
+
+    // A flush packet makes the muxer write the pending samples as one fragment
+    av_write_frame(ctx, NULL);
+
+    uint8_t *buffer = NULL;
+    int size = avio_close_dyn_buf(ctx->pb, &buffer);
+    ctx->pb = NULL;
+
+    AVBufferRef *data = NULL;
+    if (size > 0 && buffer) {
+        data = tracked_buffer(buffer, size);
+    } else {
+        av_free(buffer);
+    }
+
+    double duration = (end_dts - packager->part_start) * av_q2d(packager->time_base);
+    double segment_duration = (end_dts - packager->segment_start) * av_q2d(packager->time_base);
+    publish_part(packager, data, duration, packager->part_independent, completes_segment, segment_duration);
+
+    packager->part_start = end_dts;
+    if (completes_segment) {
+        packager->segment_start = end_dts;
+    }
+
+    if (avio_open_dyn_buf(&ctx->pb) < 0) {
+        log_error("Failed to allocate LL-HLS part buffer for stream %s", packager->stream_name);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Create a packager for a stream and publish its initialization section
+ */
+hls_ll_packager_t *hls_ll_packager_create(const char *stream_name, const AVStream *stream,
+                                          int segment_duration, int part_duration_ms) {
+    if (!stream_name || !stream || !stream->codecpar) {
+        return NULL;
+    }
+
+    hls_ll_packager_t *packager = calloc(1, sizeof(hls_ll_packager_t));
+    if (!packager) {
+        log_error("Failed to allocate LL-HLS packager for stream %s", stream_name);
+        return NULL;
+    }
+
+    strncpy(packager->stream_name, stream_name, MAX_STREAM_NAME - 1);
+    packager->stream_name[MAX_STREAM_NAME - 1] = '\0';
+    packager->packet_pool = packet_pool_acquire(stream_name);
+
+    int ret = avformat_alloc_output_context2(&packager->ctx, NULL, "mp4", NULL);
+    if (ret < 0 || !packager->ctx) {
+        log_error("Failed to allocate LL-HLS muxer for stream %s", stream_name);
+        free(packager);
+        return NULL;
+    }
+
+    AVStream *out_stream = avformat_new_stream(packager->ctx, NULL);
+    if (!out_stream || avcodec_parameters_copy(out_stream->codecpar, stream->codecpar) < 0) {
+        log_error("Failed to create LL-HLS stream for stream %s", stream_name);
+        avformat_free_context(packager->ctx);
+        free(packager);
+        return NULL;
+    }
+    out_stream->codecpar->codec_tag = 0;
+    out_stream->time_base = stream->time_base;
+
+    // Fragments are only cut when a part is finished; the moov box carries no samples
+    AVDictionary *options = NULL;
+    av_dict_set(&options, "movflags", "frag_custom+empty_moov+default_base_moof", 0);
+
+    uint8_t *buffer = NULL;
+    int size = 0;
+    if (avio_open_dyn_buf(&packager->ctx->pb) < 0 ||
+        avformat_write_header(packager->ctx, &options) < 0 ||
+        (size = avio_close_dyn_buf(packager->ctx->pb, &buffer)) <= 0) {
+        log_error("Failed to write LL-HLS initialization section for stream %s", stream_name);
+        av_dict_free(&options);
+        av_free(buffer);
+        if (packager->ctx->pb) {
+            avio_close_dyn_buf(packager->ctx->pb, &buffer);
+            av_free(buffer);
+        }
+        packager->ctx->pb = NULL;
+        avformat_free_context(packager->ctx);
+        free(packager);
+        return NULL;
+    }
+    av_dict_free(&options);
+    packager->ctx->pb = NULL;
+
+    AVBufferRef *init = tracked_buffer(buffer, size);
+
+    if (part_duration_ms < 200) {
+        part_duration_ms = 200;
+    } else if (part_duration_ms > 500) {
+        part_duration_ms = 500;
+    }
+
+    // The muxer may have changed the time base in avformat_write_header
+    packager->time_base = out_stream->time_base;
+    packager->part_target = av_rescale_q(part_duration_ms, (AVRational){1, 1000}, packager->time_base);
+    packager->segment_target = av_rescale_q(segment_duration, (AVRational){1, 1}, packager->time_base);
+    packager->part_start = AV_NOPTS_VALUE;
+    packager->segment_start = AV_NOPTS_VALUE;
+    packager->last_dts = AV_NOPTS_VALUE;
+
+    // publish_open only takes over the initialization section on success
+    if (!init || avio_open_dyn_buf(&packager->ctx->pb) < 0 ||
+        publish_open(packager, init, part_duration_ms / 1000.0, segment_duration) != 0) {
+        log_error("Failed to publish LL-HLS stream %s", stream_name);
+        av_buffer_unref(&init);
+        hls_ll_packager_destroy(packager);
+        return NULL;
+    }
+
+    log_info("Created LL-HLS packager for stream %s (%d ms parts, %d s segments)",
+            stream_name, part_duration_ms, segment_duration);
+    return packager;
+}
+
+/**
+ * Add a packet, publishing the current part first if the packet starts a new one
+ */
+int hls_ll_packager_write_packet(hls_ll_packager_t *packager, const AVPacket *pkt, AVRational time_base) {
+    if (!packager || !pkt || !packager->ctx->pb) {
+        return -1;
+    }
+
+    bool is_key = (pkt->flags & AV_PKT_FLAG_KEY) != 0;
+
+    // Segments and therefore the first part start with a keyframe
+    if (!packager->started && !is_key) {
+        return 0;
+    }
+
+    AVPacket *out = packet_pool_get_packet(packager->packet_pool);
+    if (!out) {
+        return -1;
+    }
+    if (av_packet_ref(out, pkt) < 0) {
+        packet_pool_put_packet(packager->packet_pool, &out);
+        return -1;
+    }
+
+    av_packet_rescale_ts(out, time_base, packager->time_base);
+    out->stream_index = 0;
+    out->pos = -1;
+
+    int64_t dts = out->dts != AV_NOPTS_VALUE ? out->dts : out->pts;
+    if (dts == AV_NOPTS_VALUE) {
+        packet_pool_put_packet(packager->packet_pool, &out);
+        return 0;
+    }
+
+    if (!packager->started) {
+        packager->started = true;
+        packager->part_start = dts;
+        packager->segment_start = dts;
+        packager->part_independent = true;
+    } else if (dts > packager->part_start) {
+        // End the part before this packet if including it would overshoot the target;
+        // the frame interval predicts how far the packet extends the part
+        int64_t interval = packager->last_dts != AV_NOPTS_VALUE ? dts - packager->last_dts : 0;
+        if (interval < 0) {
+            interval = 0;
+        }
+
+        bool segment_due = is_key && dts - packager->segment_start >= packager->segment_target;
+        bool part_due = dts - packager->part_start + interval > packager->part_target;
+
+        if (segment_due || part_due) {
+            if (finish_part(packager, dts, segment_due) != 0) {
+                packet_pool_put_packet(packager->packet_pool, &out);
+                return -1;
+            }
+            packager->part_independent = is_key;
+        }
+    }
+
+    packager->last_dts = dts;
+
+    int ret = av_write_frame(packager->ctx, out);
+    packet_pool_put_packet(packager->packet_pool, &out);
+
+    if (ret < 0) {
+        char error_buf[AV_ERROR_MAX_STRING_SIZE] = {0};
+        av_strerror(ret, error_buf, AV_ERROR_MAX_STRING_SIZE);
+        log_debug("LL-HLS packager dropped a packet of stream %s: %s", packager->stream_name, error_buf);
+    }
+    return 0;
+}
+
+/**
+ * Stop publishing the stream and free the packager
+ */
+void hls_ll_packager_destroy(hls_ll_packager_t *packager) {
+    if (!packager) {
+        return;
+    }
+
+    publish_close(packager);
+
+    if (packager->ctx) {
+        if (packager->ctx->pb) {
+            uint8_t *buffer = NULL;
+            avio_close_dyn_buf(packager->ctx->pb, &buffer);
+            av_free(buffer);
+            packager->ctx->pb = NULL;
+        }
+        avformat_free_context(packager->ctx);
+    }
+
+    log_info("Destroyed LL-HLS packager for stream %s", packager->stream_name);
+    free(packager);
+}
+
+/**
+ * Check whether a stream is published by a packager
+ */
+bool hls_ll_is_active(const char *stream_name) {
+    pthread_mutex_lock(&ll_mutex);
+    bool active = find_stream(stream_name) != NULL;
+    pthread_mutex_unlock(&ll_mutex);
+    return active;
+}
+
+/**
+ * Check whether the playlist contains a part, for blocking playlist reloads
+ */
+int hls_ll_playlist_ready(const char *stream_name, int64_t msn, int part) {
+    int ready = -1;
+    pthread_mutex_lock(&ll_mutex);
+
+    ll_stream_t *state = find_stream(stream_name);
+    if (state) {
+        if (msn < state->current_msn) {
+            ready = 1;
+        } else if (msn == state->current_msn) {
+            const ll_segment_t *segment = &state->segments[msn % HLS_LL_SEGMENT_COUNT];
+            ready = (part >= 0 && part < segment->part_count) ? 1 : 0;
+        } else if (msn == state->current_msn + 1) {
+            // Requests for the first part of the next segment are held as well
+            ready = 0;
+        }
+    }
+
+    pthread_mutex_unlock(&ll_mutex);
+    return ready;
+}
+
+/**
+ * Check whether a part has been published, for preload hint requests
+ */
+int hls_ll_part_ready(const char *stream_name, int64_t sequence) {
+    int ready = -1;
+    pthread_mutex_lock(&ll_mutex);
+
+    ll_stream_t *state = find_stream(stream_name);
+    if (state) {
+        if (sequence < state->next_part) {
+            ready = 1;
+        } else if (sequence == state->next_part) {
+            ready = 0;
+        }
+    }
+
+    pthread_mutex_unlock(&ll_mutex);
+    return ready;
+}
+
+/**
+ * Get how long a blocking request may be held
+ */
+int hls_ll_block_timeout_ms(const char *stream_name) {
+    int timeout_ms = 0;
+    pthread_mutex_lock(&ll_mutex);
+
+    ll_stream_t *state = find_stream(stream_name);
+    if (state) {
+        timeout_ms = state->target_duration * 3 * 1000;
+    }
+
+    pthread_mutex_unlock(&ll_mutex);
+    return timeout_ms;
+}
+
+/**
+ * Append the parts of a segment to a playlist
+ */
+static int append_parts(char *buffer, size_t size, int length, const ll_segment_t *segment) {
+    for (int i = 0; i < segment->part_count && length < (int)size; i++) {
+        const ll_part_t *part = &segment->parts[i];
+        length += snprintf(buffer + length, size - length,
+                           "#EXT-X-PART:DURATION=%.3f,URI=\"ll_part_%lld.m4s\"%s\n",
+                           part->duration, (long long)part->sequence,
+                           part->independent ? ",INDEPENDENT=YES" : "");
+    }
+    return length;
+}
+
+/**
+ * Generate the media playlist of a stream
+ */
+char *hls_ll_build_playlist(const char *stream_name, size_t *length) {
+    char *buffer = malloc(HLS_LL_PLAYLIST_SIZE);
+    if (!buffer) {
+        return NULL;
+    }
+
+    size_t size = HLS_LL_PLAYLIST_SIZE;
+    int len = -1;
+    pthread_mutex_lock(&ll_mutex);
+
+    ll_stream_t *state = find_stream(stream_name);
+    if (state && state->current_msn > state->first_msn) {
+        len = snprintf(buffer, size,
+                       "#EXTM3U\n"
+                       "#EXT-X-VERSION:6\n"
+                       "#EXT-X-TARGETDURATION:%d\n"
+                       "#EXT-X-SERVER-CONTROL:CAN-BLOCK-RELOAD=YES,PART-HOLD-BACK=%.3f\n"
+                       "#EXT-X-PART-INF:PART-TARGET=%.3f\n"
+                       "#EXT-X-MEDIA-SEQUENCE:%lld\n"
+                       "#EXT-X-MAP:URI=\"" HLS_LL_INIT_NAME "\"\n",
+                       state->target_duration, state->part_target * 3, state->part_target,
+                       (long long)state->first_msn);
+
+        for (int64_t msn = state->first_msn; msn < state->current_msn && len < (int)size; msn++) {
+            const ll_segment_t *segment = &state->segments[msn % HLS_LL_SEGMENT_COUNT];
+            if (segment->parts_listed) {
+                len = append_parts(buffer, size, len, segment);
+            }
+            if (len < (int)size) {
+                len += snprintf(buffer + len, size - len, "#EXTINF:%.3f,\nll_segment_%lld.m4s\n",
+                                segment->duration, (long long)msn);
+            }
+        }
+
+        len = append_parts(buffer, size, len, &state->segments[state->current_msn % HLS_LL_SEGMENT_COUNT]);
+        if (len < (int)size) {
+            len += snprintf(buffer + len, size - len, "#EXT-X-PRELOAD-HINT:TYPE=PART,URI=\"ll_part_%lld.m4s\"\n",
+                            (long long)state->next_part);
+        }
+    }
+
+    pthread_mutex_unlock(&ll_mutex);
+
+    if (len < 0 || len >= (int)size) {
+        if (len >= (int)size) {
+            log_warn("LL-HLS playlist of stream %s does not fit in %d bytes", stream_name, HLS_LL_PLAYLIST_SIZE);
+        }
+        free(buffer);
+        return NULL;
+    }
+
+    if (length) {
+        *length = (size_t)len;
+    }
+    return buffer;
+}
+
+/**
+ * Get the initialization section, a part or a segment of a stream
+ */
+int hls_ll_get_resource(const char *stream_name, const char *file_name, AVBufferRef **data) {
+    if (!file_name || !data) {
+        return -1;
+    }
+    *data = NULL;
+
+    long long number = 0;
+    char suffix[8] = {0};
+    bool is_init = strcmp(file_name, HLS_LL_INIT_NAME) == 0;
+    bool is_part = !is_init && sscanf(file_name, "ll_part_%lld.%7s", &number, suffix) == 2 &&
+                   strcmp(suffix, "m4s") == 0;
+    bool is_segment = !is_init && !is_part && sscanf(file_name, "ll_segment_%lld.%7s", &number, suffix) == 2 &&
+                      strcmp(suffix, "m4s") == 0;
+    if (!is_init && !is_part && !is_segment) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&ll_mutex);
+
+    ll_stream_t *state = find_stream(stream_name);
+    if (state && is_init && state->init) {
+        *data = av_buffer_ref(state->init);
+    } else if (state && is_segment && number >= state->first_msn && number < state->current_msn) {
+        const ll_segment_t *segment = &state->segments[number % HLS_LL_SEGMENT_COUNT];
+        if (segment->data) {
+            *data = av_buffer_ref(segment->data);
+        }
+    } else if (state && is_part) {
+        // Parts are only kept for the newest complete segment and the current one
+        for (int64_t msn = state->current_msn; msn >= state->first_msn && msn + 1 >= state->current_msn && !*data; msn--) {
+            const ll_segment_t *segment = &state->segments[msn % HLS_LL_SEGMENT_COUNT];
+            for (int i = 0; i < segment->part_count; i++) {
+                if (segment->parts[i].sequence == number) {
+                    *data = av_buffer_ref(segment->parts[i].data);
+                    break;
+                }
+            }
+        }
+    }
+
+    pthread_mutex_unlock(&ll_mutex);
+    return *data ? 0 : -1;
+}
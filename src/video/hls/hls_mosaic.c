@@ -0,0 +1,698 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+#include <libavutil/time.h>
+#include <libswscale/swscale.h>
+
+#include "core/config.h"
+#include "core/logger.h"
+#include "core/shutdown_coordinator.h"
+#include "video/ffmpeg_utils.h"
+#include "video/hw_decode.h"
+#include "video/stream_ingest.h"
+#include "video/stream_manager.h"
+#include "video/stream_transcoding.h"
+#include "video/thread_utils.h"
+#include "video/hls/hls_unified_thread.h"
+#include "video/hls/hls_mosaic.h"
+
+// Segment length of the mosaic; key frames are placed on it
+#define MOSAIC_SEGMENT_SECONDS 2
+#define MOSAIC_PLAYLIST_SIZE 5
+
+// Tiles whose stream sent no picture for this long are shown black
+#define MOSAIC_STALE_SECONDS 10
+
+// A grid changes little between frames, so it gets a fraction of a full-rate encode
+#define MOSAIC_RATE_DIVISOR 10
+#define MOSAIC_MIN_BIT_RATE 500000
+
+typedef struct mosaic mosaic_t;
+
+/**
+ * One tile of the mosaic
+ * picture and updated_us are guarded by mutex, the rest belongs to the tile's thread.
+ */
+typedef struct {
+    mosaic_t *mosaic;
+    char stream_name[MAX_STREAM_NAME];
+    pthread_t thread;
+    bool thread_started;
+    pthread_mutex_t mutex;
+    AVFrame *picture;               // Latest picture, tile-sized in the encoder's format
+    int64_t updated_us;             // av_gettime_relative() of the picture, 0 for none
+} mosaic_tile_t;
+
+// The mosaic, freed by its compositor thread
+struct mosaic {
+    char name[MAX_STREAM_NAME];
+    atomic_int running;             // Cleared under mosaic_mutex once the mosaic is leaving
+    int64_t requested_us;           // Guarded by mosaic_mutex
+    int fps;
+    int columns;
+    int rows;
+    int tile_width;
+    int tile_height;
+    enum AVPixelFormat format;
+    mosaic_tile_t tiles[HLS_MOSAIC_MAX_TILES];
+    int tile_count;
+    char dir[MAX_PATH_LENGTH];
+};
+
+static mosaic_t *mosaic;
+static pthread_mutex_t mosaic_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Delete the files of a directory and the directory
+ */
+static void remove_mosaic_dir(const char *dir) {
+    DIR *d = opendir(dir);
+    if (!d) {
+        return;
+    }
+
+    struct dirent *entry;
+    char path[MAX_PATH_LENGTH * 2];
+    while ((entry = readdir(d)) != NULL) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+        if (unlink(path) != 0 && errno != ENOENT) {
+            log_warn("Failed to delete %s: %s", path, strerror(errno));
+        }
+    }
+    closedir(d);
+
+    if (rmdir(dir) != 0 && errno != ENOENT) {
+        log_warn("Failed to delete mosaic directory %s: %s", dir, strerror(errno));
+    }
+}
+
+/**
+ * Paint a frame black
+ */
+static void fill_black(AVFrame *frame) {
+    ptrdiff_t linesize[4];
+    for (int i = 0; i < 4; i++) {
+        linesize[i] = frame->linesize[i];
+    }
+    av_image_fill_black(frame->data, linesize, frame->format, AVCOL_RANGE_MPEG, frame->width, frame->height);
+}
+
+/**
+ * Copy a tile's picture into the grid at a pixel position
+ */
+static void copy_tile(AVFrame *canvas, const AVFrame *picture, int x, int y) {
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(canvas->format);
+    if (!desc) {
+        return;
+    }
+
+    for (int p = 0; p < 4 && picture->data[p]; p++) {
+        int shift_y = p == 1 || p == 2 ? desc->log2_chroma_h : 0;
+        int bytes = av_image_get_linesize(canvas->format, picture->width, p);
+        int offset = av_image_get_linesize(canvas->format, x, p);
+        int rows = AV_CEIL_RSHIFT(picture->height, shift_y);
+        if (bytes <= 0 || offset < 0) {
+            continue;
+        }
+
+        uint8_t *dst = canvas->data[p] + (ptrdiff_t)(y >> shift_y) * canvas->linesize[p] + offset;
+        const uint8_t *src = picture->data[p];
+        for (int row = 0; row < rows; row++) {
+            memcpy(dst, src, (size_t)bytes);
+            dst += canvas->linesize[p];
+            src += picture->linesize[p];
+        }
+    }
+}
+
+/**
+ * Check whether the mosaic was requested recently, marking it as leaving otherwise
+ */
+static bool mosaic_wanted(mosaic_t *m) {
+    int64_t idle_us = (int64_t)g_config.hls_idle_timeout * 1000000;
+
+    pthread_mutex_lock(&mosaic_mutex);
+    bool wanted = m->requested_us > 0 && av_gettime_relative() - m->requested_us < idle_us;
+    if (!wanted) {
+        atomic_store(&m->running, 0);
+    }
+    pthread_mutex_unlock(&mosaic_mutex);
+    return wanted;
+}
+
+/**
+ * Open the decoder of a tile's video stream
+ *
+ * @return Decoder context or NULL on failure
+ */
+static AVCodecContext *open_tile_decoder(mosaic_tile_t *tile, stream_ingest_consumer_t *consumer,
+                                         int *video_stream_idx) {
+    AVFormatContext *fmt_ctx = stream_ingest_get_format_context(consumer);
+    int idx = stream_ingest_get_video_stream_index(consumer);
+    if (!fmt_ctx || idx < 0 || idx >= (int)fmt_ctx->nb_streams) {
+        return NULL;
+    }
+
+    const AVStream *stream = fmt_ctx->streams[idx];
+    const AVCodec *codec = hw_decode_find_decoder(stream->codecpar->codec_id);
+    AVCodecContext *codec_ctx = codec ? avcodec_alloc_context3(codec) : NULL;
+    if (!codec_ctx || avcodec_parameters_to_context(codec_ctx, stream->codecpar) < 0) {
+        log_error("[Stream %s] Failed to set up mosaic decoder", tile->stream_name);
+        avcodec_free_context(&codec_ctx);
+        return NULL;
+    }
+
+    codec_ctx->pkt_timebase = stream->time_base;
+    hw_decode_setup(codec_ctx);
+
+    int ret = avcodec_open2(codec_ctx, codec, NULL);
+    if (ret < 0) {
+        log_ffmpeg_error(ret, "Failed to open mosaic decoder");
+        avcodec_free_context(&codec_ctx);
+        return NULL;
+    }
+
+    *video_stream_idx = idx;
+    return codec_ctx;
+}
+
+/**
+ * Scale a decoded picture into a tile
+ */
+static void update_tile(mosaic_tile_t *tile, struct SwsContext **sws_ctx, const AVFrame *src) {
+    *sws_ctx = sws_getCachedContext(*sws_ctx, src->width, src->height, src->format,
+                                    tile->picture->width, tile->picture->height, tile->picture->format,
+                                    SWS_BILINEAR, NULL, NULL, NULL);
+    if (!*sws_ctx) {
+        return;
+    }
+
+    pthread_mutex_lock(&tile->mutex);
+    sws_scale(*sws_ctx, (const uint8_t * const *)src->data, src->linesize, 0, src->height,
+              tile->picture->data, tile->picture->linesize);
+    tile->updated_us = av_gettime_relative();
+    pthread_mutex_unlock(&tile->mutex);
+}
+
+/**
+ * Tile thread
+ * Decodes one stream from its shared ingest and keeps the latest picture, at
+ * most once per mosaic frame, until the mosaic stops.
+ */
+static void *mosaic_tile_thread(void *arg) {
+    mosaic_tile_t *tile = (mosaic_tile_t *)arg;
+    mosaic_t *m = tile->mosaic;
+    thread_set_identity(THREAD_CLASS_HLS, "mosaic", tile->stream_name);
+
+    stream_ingest_consumer_t *consumer = NULL;
+    AVCodecContext *decoder = NULL;
+    struct SwsContext *sws_ctx = NULL;
+    AVPacket *pkt = av_packet_alloc();
+    AVFrame *frame = av_frame_alloc();
+    AVFrame *sw_frame = av_frame_alloc();
+    int video_stream_idx = -1;
+    bool decoder_synced = false;
+    int64_t interval_us = 1000000 / m->fps;
+    int64_t scaled_us = 0;
+
+    while (pkt && frame && sw_frame && atomic_load(&m->running) && !is_shutdown_initiated()) {
+        if (!consumer) {
+            // The stream's HLS thread knows its input; it may not be running yet
+            char url[MAX_URL_LENGTH] = {0};
+            int protocol = STREAM_PROTOCOL_TCP;
+            if (get_hls_stream_input(tile->stream_name, url, sizeof(url), &protocol) == 0) {
+                consumer = stream_ingest_attach_with_gop(tile->stream_name, url, protocol, "mosaic", 0, true);
+            }
+            if (!consumer) {
+                usleep(1000000);
+                continue;
+            }
+        }
+
+        if (!decoder) {
+            int ret = stream_ingest_wait_for_streams(consumer, 1000);
+            if (ret == AVERROR_EOF) {
+                stream_ingest_detach(consumer);
+                consumer = NULL;
+                continue;
+            }
+            if (ret != 0) {
+                continue;
+            }
+
+            decoder = open_tile_decoder(tile, consumer, &video_stream_idx);
+            if (!decoder) {
+                usleep(1000000);
+                continue;
+            }
+            decoder_synced = false;
+        }
+
+        int ret = stream_ingest_read_packet(consumer, pkt, 500);
+        if (ret == AVERROR(EAGAIN)) {
+            continue;
+        }
+        if (ret == STREAM_INGEST_STREAMS_CHANGED) {
+            avcodec_free_context(&decoder);
+            continue;
+        }
+        if (ret < 0) {
+            // The ingest is stopping; attach again once it is back
+            avcodec_free_context(&decoder);
+            stream_ingest_detach(consumer);
+            consumer = NULL;
+            continue;
+        }
+
+        if (pkt->stream_index != video_stream_idx ||
+            (!decoder_synced && !(pkt->flags & AV_PKT_FLAG_KEY))) {
+            av_packet_unref(pkt);
+            continue;
+        }
+        decoder_synced = true;
+
+        if (avcodec_send_packet(decoder, pkt) == 0) {
+            while (avcodec_receive_frame(decoder, frame) == 0) {
+                // Every frame is decoded, but only as many are scaled as the mosaic shows
+                int64_t now = av_gettime_relative();
+                if (now - scaled_us >= interval_us) {
+                    const AVFrame *src = hw_decode_get_sw_frame(frame, sw_frame);
+                    if (src) {
+                        update_tile(tile, &sws_ctx, src);
+                        scaled_us = now;
+                    }
+                }
+                av_frame_unref(frame);
+            }
+        }
+        av_packet_unref(pkt);
+    }
+
+    sws_freeContext(sws_ctx);
+    avcodec_free_context(&decoder);
+    av_frame_free(&sw_frame);
+    av_frame_free(&frame);
+    av_packet_free(&pkt);
+    if (consumer) {
+        stream_ingest_detach(consumer);
+    }
+    return NULL;
+}
+
+/**
+ * Start the HLS muxer of the mosaic
+ *
+ * @return Muxer or NULL on failure
+ */
+static AVFormatContext *open_mosaic_muxer(mosaic_t *m, const transcode_encoder_t *encoder) {
+    // Leftovers of an earlier run would be served as if the mosaic were ready
+    remove_mosaic_dir(m->dir);
+    if (mkdir(m->dir, 0755) != 0 && errno != EEXIST) {
+        log_error("[Mosaic %s] Failed to create %s: %s", m->name, m->dir, strerror(errno));
+        return NULL;
+    }
+
+    char playlist[MAX_PATH_LENGTH + 16];
+    char segment_pattern[MAX_PATH_LENGTH + 16];
+    snprintf(playlist, sizeof(playlist), "%s/index.m3u8", m->dir);
+    snprintf(segment_pattern, sizeof(segment_pattern), "%s/segment_%%d.ts", m->dir);
+
+    AVFormatContext *muxer = NULL;
+    int ret = avformat_alloc_output_context2(&muxer, NULL, "hls", playlist);
+    if (ret < 0 || !muxer) {
+        log_ffmpeg_error(ret, "Failed to create mosaic muxer");
+        return NULL;
+    }
+
+    AVStream *stream = avformat_new_stream(muxer, NULL);
+    if (!stream || avcodec_parameters_from_context(stream->codecpar, encoder->codec_ctx) < 0) {
+        log_error("[Mosaic %s] Failed to set up mosaic stream", m->name);
+        avformat_free_context(muxer);
+        return NULL;
+    }
+    stream->time_base = encoder->codec_ctx->time_base;
+
+    AVDictionary *options = NULL;
+    av_dict_set_int(&options, "hls_time", MOSAIC_SEGMENT_SECONDS, 0);
+    av_dict_set_int(&options, "hls_list_size", MOSAIC_PLAYLIST_SIZE, 0);
+    av_dict_set(&options, "hls_segment_type", "mpegts", 0);
+    av_dict_set(&options, "hls_flags", "delete_segments+independent_segments", 0);
+    av_dict_set(&options, "hls_segment_filename", segment_pattern, 0);
+    av_dict_set(&options, "start_number", "0", 0);
+
+    ret = avformat_write_header(muxer, &options);
+    av_dict_free(&options);
+    if (ret < 0) {
+        log_ffmpeg_error(ret, "Failed to start mosaic playlist");
+        avformat_free_context(muxer);
+        return NULL;
+    }
+    return muxer;
+}
+
+/**
+ * Write the packets the encoder has ready to the mosaic's playlist
+ *
+ * @return 0 on success, negative AVERROR on error
+ */
+static int write_mosaic_packets(transcode_encoder_t *encoder, AVFormatContext *muxer, AVPacket *pkt) {
+    AVCodecContext *codec_ctx = encoder->codec_ctx;
+    int ret;
+    while ((ret = avcodec_receive_packet(codec_ctx, pkt)) == 0) {
+        pkt->stream_index = 0;
+        av_packet_rescale_ts(pkt, codec_ctx->time_base, muxer->streams[0]->time_base);
+        ret = av_interleaved_write_frame(muxer, pkt);
+        if (ret < 0) {
+            av_packet_unref(pkt);
+            return ret;
+        }
+    }
+    return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF ? 0 : ret;
+}
+
+/**
+ * Copy the tiles' latest pictures into the grid
+ */
+static void compose(mosaic_t *m, AVFrame *canvas) {
+    int64_t stale_us = (int64_t)MOSAIC_STALE_SECONDS * 1000000;
+    int64_t now = av_gettime_relative();
+
+    for (int i = 0; i < m->tile_count; i++) {
+        mosaic_tile_t *tile = &m->tiles[i];
+        pthread_mutex_lock(&tile->mutex);
+        if (tile->updated_us > 0 && now - tile->updated_us >= stale_us) {
+            // A frozen picture would pass for a live one
+            fill_black(tile->picture);
+            tile->updated_us = 0;
+        }
+        copy_tile(canvas, tile->picture, (i % m->columns) * m->tile_width, (i / m->columns) * m->tile_height);
+        pthread_mutex_unlock(&tile->mutex);
+    }
+}
+
+/**
+ * Compositor thread
+ * Opens the encoder, starts the tile threads and encodes the grid at the
+ * mosaic frame rate until the mosaic is no longer requested.
+ */
+static void *mosaic_thread(void *arg) {
+    mosaic_t *m = (mosaic_t *)arg;
+    thread_set_identity(THREAD_CLASS_HLS, "mosaic", m->name);
+
+    int width = m->tile_width * m->columns;
+    int height = m->tile_height * m->rows;
+    int64_t bit_rate = transcode_bit_rate(height) * m->fps / MOSAIC_RATE_DIVISOR;
+    if (bit_rate < MOSAIC_MIN_BIT_RATE) {
+        bit_rate = MOSAIC_MIN_BIT_RATE;
+    }
+
+    transcode_encoder_t encoder = {0};
+    AVFormatContext *muxer = NULL;
+    AVFrame *canvas = av_frame_alloc();
+    AVPacket *pkt = av_packet_alloc();
+
+    int ret = transcode_encoder_open(&encoder, width, height, (AVRational){1, m->fps}, (AVRational){m->fps, 1},
+                                     bit_rate, m->fps * MOSAIC_SEGMENT_SECONDS, false);
+    if (ret != 0 || !canvas || !pkt) {
+        log_error("[Mosaic %s] Failed to open the mosaic encoder%s", m->name,
+                 ret == TRANSCODE_ENCODER_BUSY ? ", all software encoders are in use" : "");
+        goto cleanup;
+    }
+
+    m->format = encoder.sw_format;
+    canvas->format = m->format;
+    canvas->width = width;
+    canvas->height = height;
+    if (av_frame_get_buffer(canvas, 0) < 0) {
+        goto cleanup;
+    }
+    fill_black(canvas);
+
+    for (int i = 0; i < m->tile_count; i++) {
+        AVFrame *picture = av_frame_alloc();
+        if (!picture) {
+            goto cleanup;
+        }
+        picture->format = m->format;
+        picture->width = m->tile_width;
+        picture->height = m->tile_height;
+        m->tiles[i].picture = picture;
+        if (av_frame_get_buffer(picture, 0) < 0) {
+            goto cleanup;
+        }
+        fill_black(picture);
+    }
+
+    muxer = open_mosaic_muxer(m, &encoder);
+    if (!muxer) {
+        goto cleanup;
+    }
+
+    for (int i = 0; i < m->tile_count; i++) {
+        mosaic_tile_t *tile = &m->tiles[i];
+        if (pthread_create_with_stack(&tile->thread, mosaic_tile_thread, tile, STREAM_THREAD_STACK_SIZE, false) != 0) {
+            log_error("[Mosaic %s] Failed to start the tile of stream %s", m->name, tile->stream_name);
+            continue;
+        }
+        tile->thread_started = true;
+    }
+
+    log_info("[Mosaic %s] Writing %dx%d mosaic of %d streams at %d fps (%s encoder %s)", m->name,
+            width, height, m->tile_count, m->fps, encoder.hardware ? "hardware" : "software",
+            encoder.codec_ctx->codec->name);
+
+    int64_t interval_us = 1000000 / m->fps;
+    int64_t next_us = av_gettime_relative();
+    int64_t frame_index = 0;
+
+    while (atomic_load(&m->running) && !is_shutdown_initiated() && mosaic_wanted(m)) {
+        if (av_frame_make_writable(canvas) < 0) {
+            break;
+        }
+        compose(m, canvas);
+        canvas->pts = frame_index++;
+
+        ret = transcode_encoder_send_frame(&encoder, canvas);
+        if (ret < 0 && ret != AVERROR(EAGAIN)) {
+            log_ffmpeg_error(ret, "Failed to encode mosaic frame");
+            break;
+        }
+        ret = write_mosaic_packets(&encoder, muxer, pkt);
+        if (ret < 0) {
+            log_ffmpeg_error(ret, "Failed to write mosaic segment");
+            break;
+        }
+
+        next_us += interval_us;
+        int64_t wait_us = next_us - av_gettime_relative();
+        if (wait_us > 0) {
+            av_usleep((unsigned)wait_us);
+        } else if (wait_us < -interval_us) {
+            // Fell behind; keep the frame rate rather than catching up
+            next_us = av_gettime_relative();
+        }
+    }
+
+cleanup:
+    pthread_mutex_lock(&mosaic_mutex);
+    atomic_store(&m->running, 0);
+    pthread_mutex_unlock(&mosaic_mutex);
+
+    for (int i = 0; i < m->tile_count; i++) {
+        if (m->tiles[i].thread_started) {
+            pthread_join(m->tiles[i].thread, NULL);
+        }
+    }
+
+    if (muxer) {
+        av_write_trailer(muxer);
+        avformat_free_context(muxer);
+    }
+    remove_mosaic_dir(m->dir);
+    transcode_encoder_close(&encoder);
+    av_frame_free(&canvas);
+    av_packet_free(&pkt);
+    for (int i = 0; i < m->tile_count; i++) {
+        av_frame_free(&m->tiles[i].picture);
+        pthread_mutex_destroy(&m->tiles[i].mutex);
+    }
+
+    log_info("[Mosaic %s] Mosaic stopped", m->name);
+
+    pthread_mutex_lock(&mosaic_mutex);
+    if (mosaic == m) {
+        mosaic = NULL;
+    }
+    pthread_mutex_unlock(&mosaic_mutex);
+
+    free(m);
+    return NULL;
+}
+
+/**
+ * Add a stream to the mosaic unless it is there already
+ */
+static void add_tile(mosaic_t *m, const char *stream_name) {
+    if (m->tile_count >= HLS_MOSAIC_MAX_TILES || stream_name[0] == '\0' ||
+        strcmp(stream_name, m->name) == 0) {
+        return;
+    }
+    for (int i = 0; i < m->tile_count; i++) {
+        if (strcmp(m->tiles[i].stream_name, stream_name) == 0) {
+            return;
+        }
+    }
+
+    mosaic_tile_t *tile = &m->tiles[m->tile_count++];
+    tile->mosaic = m;
+    strncpy(tile->stream_name, stream_name, MAX_STREAM_NAME - 1);
+    pthread_mutex_init(&tile->mutex, NULL);
+}
+
+/**
+ * Create and start the mosaic
+ * Must be called with mosaic_mutex held.
+ */
+static mosaic_t *start_mosaic(void) {
+    mosaic_t *m = calloc(1, sizeof(mosaic_t));
+    if (!m) {
+        log_error("Failed to allocate the mosaic");
+        return NULL;
+    }
+
+    strncpy(m->name, g_config.hls_mosaic_name, MAX_STREAM_NAME - 1);
+    m->fps = g_config.hls_mosaic_fps > 0 ? g_config.hls_mosaic_fps : 1;
+    atomic_init(&m->running, 1);
+    hls_mosaic_get_dir(m->dir, sizeof(m->dir));
+
+    if (strcmp(g_config.hls_mosaic_streams, "*") == 0) {
+        for (int i = 0; i < g_config.max_streams; i++) {
+            const stream_config_t *config = stream_config_acquire(get_stream_by_index(i));
+            if (config && config->enabled) {
+                add_tile(m, config->name);
+            }
+            stream_config_release(config);
+        }
+    } else {
+        char list[sizeof(g_config.hls_mosaic_streams)];
+        strncpy(list, g_config.hls_mosaic_streams, sizeof(list) - 1);
+        list[sizeof(list) - 1] = '\0';
+
+        char *saveptr = NULL;
+        for (char *token = strtok_r(list, ",", &saveptr); token; token = strtok_r(NULL, ",", &saveptr)) {
+            while (*token == ' ') {
+                token++;
+            }
+            size_t len = strlen(token);
+            while (len > 0 && token[len - 1] == ' ') {
+                token[--len] = '\0';
+            }
+            add_tile(m, token);
+        }
+    }
+
+    if (m->tile_count == 0) {
+        log_warn("No streams to tile into mosaic %s", m->name);
+        free(m);
+        return NULL;
+    }
+
+    // The smallest square grid holding every tile, in a 16:9 frame
+    while (m->columns * m->columns < m->tile_count) {
+        m->columns++;
+    }
+    m->rows = (m->tile_count + m->columns - 1) / m->columns;
+    int height = g_config.hls_mosaic_height;
+    int width = height * 16 / 9;
+    m->tile_width = (width / m->columns) & ~1;
+    m->tile_height = (height / m->rows) & ~1;
+
+    pthread_t thread;
+    if (pthread_create_with_stack(&thread, mosaic_thread, m, STREAM_THREAD_STACK_SIZE, true) != 0) {
+        log_error("Failed to create the thread of mosaic %s", m->name);
+        for (int i = 0; i < m->tile_count; i++) {
+            pthread_mutex_destroy(&m->tiles[i].mutex);
+        }
+        free(m);
+        return NULL;
+    }
+
+    return m;
+}
+
+bool hls_mosaic_is_name(const char *stream_name) {
+    return stream_name && g_config.hls_mosaic_streams[0] != '\0' &&
+           strcmp(stream_name, g_config.hls_mosaic_name) == 0;
+}
+
+int hls_mosaic_request(void) {
+    if (g_config.hls_mosaic_streams[0] == '\0' || !stream_ingest_enabled()) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&mosaic_mutex);
+
+    int result = 0;
+    if (!mosaic) {
+        mosaic = start_mosaic();
+        if (!mosaic) {
+            pthread_mutex_unlock(&mosaic_mutex);
+            return -1;
+        }
+        result = 1;
+    } else if (!atomic_load(&mosaic->running)) {
+        // Leaving mosaic; the next request starts a new one
+        pthread_mutex_unlock(&mosaic_mutex);
+        return 1;
+    }
+
+    mosaic->requested_us = av_gettime_relative();
+
+    pthread_mutex_unlock(&mosaic_mutex);
+    return result;
+}
+
+void hls_mosaic_get_dir(char *dir, size_t size) {
+    const char *base = g_config.storage_path_hls[0] != '\0' ? g_config.storage_path_hls : g_config.storage_path;
+    snprintf(dir, size, "%s/hls/%s", base, g_config.hls_mosaic_name);
+}
+
+void hls_mosaic_stop(void) {
+    pthread_mutex_lock(&mosaic_mutex);
+    mosaic_t *m = mosaic;
+    if (m) {
+        atomic_store(&m->running, 0);
+    }
+    pthread_mutex_unlock(&mosaic_mutex);
+
+    if (!m) {
+        return;
+    }
+
+    // The tiles leave their loops within one read timeout
+    for (int i = 0; i < 100; i++) {
+        usleep(50000);
+        pthread_mutex_lock(&mosaic_mutex);
+        bool stopped = mosaic != m;
+        pthread_mutex_unlock(&mosaic_mutex);
+        if (stopped) {
+            return;
+        }
+    }
+
+    log_warn("Mosaic did not stop in time");
+}
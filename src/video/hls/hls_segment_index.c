@@ -0,0 +1,335 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "core/logger.h"
+#include "video/stream_registry.h"
+#include "video/hls/hls_segment_index.h"
+
+/**
+ * Segment ring of one stream
+ * Rings are indexed by stream registry ID; an active ring holds a reference
+ * on its ID. Rings are allocated on first use and reused afterwards.
+ */
+typedef struct {
+    bool active;
+    const void *owner;
+    int stream_id;
+    char stream_name[MAX_STREAM_NAME];
+    char directory[MAX_PATH_LENGTH];
+    hls_segment_info_t segments[HLS_SEGMENT_INDEX_SIZE];
+    AVBufferRef *data[HLS_SEGMENT_INDEX_SIZE];  // Segment data when kept in memory
+    int first;                  // Slot of the oldest segment
+    int count;
+    int retain;
+    pthread_cond_t cond;        // Signaled when a segment is added or the ring closes
+} segment_ring_t;
+
+static segment_ring_t *rings[MAX_STREAMS];
+static pthread_mutex_t index_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Find the active ring of a stream
+ * Must be called with index_mutex held.
+ */
+static segment_ring_t *find_ring(const char *stream_name) {
+    if (!stream_name || stream_name[0] == '\0') {
+        return NULL;
+    }
+
+    int id = stream_registry_lookup(stream_name);
+    if (id < 0 || id >= MAX_STREAMS) {
+        return NULL;
+    }
+
+    segment_ring_t *ring = rings[id];
+    if (!ring || !ring->active || strcmp(ring->stream_name, stream_name) != 0) {
+        return NULL;
+    }
+    return ring;
+}
+
+/**
+ * Get the newest segment of a ring
+ * Must be called with index_mutex held.
+ */
+static const hls_segment_info_t *newest_segment(const segment_ring_t *ring) {
+    if (ring->count == 0) {
+        return NULL;
+    }
+    return &ring->segments[(ring->first + ring->count - 1) % HLS_SEGMENT_INDEX_SIZE];
+}
+
+/**
+ * Drop all segments of a ring
+ * Must be called with index_mutex held.
+ */
+static void clear_ring(segment_ring_t *ring) {
+    for (int i = 0; i < HLS_SEGMENT_INDEX_SIZE; i++) {
+        av_buffer_unref(&ring->data[i]);
+    }
+    ring->first = 0;
+    ring->count = 0;
+}
+
+/**
+ * Start indexing the segments of a stream
+ */
+int hls_segment_index_open(const char *stream_name, const char *directory, int retain, const void *owner) {
+    if (!stream_name || stream_name[0] == '\0' || !directory || !owner) {
+        return -1;
+    }
+
+    if (retain < 1 || retain > HLS_SEGMENT_INDEX_SIZE) {
+        retain = HLS_SEGMENT_INDEX_SIZE;
+    }
+
+    int id = stream_registry_acquire(stream_name);
+    if (id == STREAM_ID_INVALID || id >= MAX_STREAMS) {
+        stream_registry_release(id);
+        log_error("Failed to register HLS segment index for stream %s", stream_name);
+        return -1;
+    }
+
+    pthread_mutex_lock(&index_mutex);
+
+    segment_ring_t *ring = rings[id];
+    if (!ring) {
+        ring = calloc(1, sizeof(segment_ring_t));
+        if (!ring) {
+            pthread_mutex_unlock(&index_mutex);
+            stream_registry_release(id);
+            log_error("Failed to allocate HLS segment index for stream %s", stream_name);
+            return -1;
+        }
+        pthread_cond_init(&ring->cond, NULL);
+        rings[id] = ring;
+    }
+
+    // A previous writer that was never closed already holds the ID
+    bool replaced = ring->active;
+
+    ring->active = true;
+    ring->owner = owner;
+    ring->stream_id = id;
+    strncpy(ring->stream_name, stream_name, MAX_STREAM_NAME - 1);
+    ring->stream_name[MAX_STREAM_NAME - 1] = '\0';
+    strncpy(ring->directory, directory, MAX_PATH_LENGTH - 1);
+    ring->directory[MAX_PATH_LENGTH - 1] = '\0';
+    clear_ring(ring);
+    ring->retain = retain;
+
+    // Readers waiting on the previous writer start over with the new one
+    pthread_cond_broadcast(&ring->cond);
+    pthread_mutex_unlock(&index_mutex);
+
+    if (replaced) {
+        stream_registry_release(id);
+    }
+
+    log_debug("Opened HLS segment index for stream %s (%d segments)", stream_name, retain);
+    return 0;
+}
+
+/**
+ * Stop indexing the segments of a stream
+ */
+void hls_segment_index_close(const char *stream_name, const void *owner) {
+    pthread_mutex_lock(&index_mutex);
+
+    segment_ring_t *ring = find_ring(stream_name);
+    if (!ring || ring->owner != owner) {
+        pthread_mutex_unlock(&index_mutex);
+        return;
+    }
+
+    int id = ring->stream_id;
+    ring->active = false;
+    ring->owner = NULL;
+    clear_ring(ring);
+    pthread_cond_broadcast(&ring->cond);
+    pthread_mutex_unlock(&index_mutex);
+
+    stream_registry_release(id);
+    log_debug("Closed HLS segment index for stream %s", stream_name);
+}
+
+/**
+ * Record a completed segment
+ */
+int hls_segment_index_add(const char *stream_name, const void *owner, const hls_segment_info_t *segment,
+                          AVBufferRef *data) {
+    if (!segment) {
+        av_buffer_unref(&data);
+        return -1;
+    }
+
+    pthread_mutex_lock(&index_mutex);
+
+    segment_ring_t *ring = find_ring(stream_name);
+    if (!ring || ring->owner != owner) {
+        pthread_mutex_unlock(&index_mutex);
+        av_buffer_unref(&data);
+        return -1;
+    }
+
+    if (ring->count == ring->retain) {
+        // Readers still sending the data of the oldest segment hold their own reference
+        av_buffer_unref(&ring->data[ring->first]);
+        ring->first = (ring->first + 1) % HLS_SEGMENT_INDEX_SIZE;
+        ring->count--;
+    }
+
+    int slot = (ring->first + ring->count) % HLS_SEGMENT_INDEX_SIZE;
+    ring->segments[slot] = *segment;
+    av_buffer_unref(&ring->data[slot]);
+    ring->data[slot] = data;
+    ring->count++;
+
+    pthread_cond_broadcast(&ring->cond);
+    pthread_mutex_unlock(&index_mutex);
+    return 0;
+}
+
+/**
+ * Check whether the segments of a stream are indexed
+ */
+bool hls_segment_index_is_active(const char *stream_name) {
+    pthread_mutex_lock(&index_mutex);
+    bool active = find_ring(stream_name) != NULL;
+    pthread_mutex_unlock(&index_mutex);
+    return active;
+}
+
+/**
+ * Get the newest completed segment of a stream
+ */
+int hls_segment_index_get_latest(const char *stream_name, hls_segment_info_t *segment, int *count) {
+    if (!segment) {
+        return -1;
+    }
+
+    int ret = -1;
+    pthread_mutex_lock(&index_mutex);
+
+    segment_ring_t *ring = find_ring(stream_name);
+    const hls_segment_info_t *newest = ring ? newest_segment(ring) : NULL;
+    if (newest) {
+        *segment = *newest;
+        if (count) {
+            *count = ring->count;
+        }
+        ret = 0;
+    }
+
+    pthread_mutex_unlock(&index_mutex);
+    return ret;
+}
+
+/**
+ * Find an indexed segment by file name
+ */
+int hls_segment_index_find(const char *stream_name, const char *file_name, hls_segment_info_t *segment,
+                           AVBufferRef **data) {
+    if (data) {
+        *data = NULL;
+    }
+
+    if (!file_name || file_name[0] == '\0') {
+        return -1;
+    }
+
+    int ret = -1;
+    pthread_mutex_lock(&index_mutex);
+
+    segment_ring_t *ring = find_ring(stream_name);
+    for (int i = 0; ring && i < ring->count; i++) {
+        int slot = (ring->first + i) % HLS_SEGMENT_INDEX_SIZE;
+        const hls_segment_info_t *entry = &ring->segments[slot];
+        const char *base = strrchr(entry->path, '/');
+        base = base ? base + 1 : entry->path;
+
+        if (strcmp(base, file_name) == 0) {
+            if (segment) {
+                *segment = *entry;
+            }
+            if (data && ring->data[slot]) {
+                *data = av_buffer_ref(ring->data[slot]);
+            }
+            ret = 0;
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&index_mutex);
+    return ret;
+}
+
+/**
+ * Get the directory the segments of a stream are written to
+ */
+int hls_segment_index_get_directory(const char *stream_name, char *directory, size_t size) {
+    if (!directory || size == 0) {
+        return -1;
+    }
+
+    int ret = -1;
+    pthread_mutex_lock(&index_mutex);
+
+    segment_ring_t *ring = find_ring(stream_name);
+    if (ring) {
+        strncpy(directory, ring->directory, size - 1);
+        directory[size - 1] = '\0';
+        ret = 0;
+    }
+
+    pthread_mutex_unlock(&index_mutex);
+    return ret;
+}
+
+/**
+ * Wait until a segment newer than a sequence number is completed
+ */
+int hls_segment_index_wait(const char *stream_name, int64_t after_sequence, int timeout_ms,
+                           hls_segment_info_t *segment) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    int ret = -1;
+    pthread_mutex_lock(&index_mutex);
+
+    segment_ring_t *ring = find_ring(stream_name);
+    const void *owner = ring ? ring->owner : NULL;
+    while (ring) {
+        const hls_segment_info_t *newest = newest_segment(ring);
+        if (newest && newest->sequence > after_sequence) {
+            if (segment) {
+                *segment = *newest;
+            }
+            ret = 0;
+            break;
+        }
+
+        if (timeout_ms <= 0 ||
+            pthread_cond_timedwait(&ring->cond, &index_mutex, &deadline) == ETIMEDOUT) {
+            break;
+        }
+
+        // Stop waiting if the writer went away or was replaced
+        if (!ring->active || ring->owner != owner) {
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&index_mutex);
+    return ret;
+}
@@ -23,6 +23,7 @@
 #include <signal.h>
 #include <sys/signal.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
@@ -42,15 +43,12 @@
 #include "core/logger.h"
 #include "core/config.h"
 #include "core/shutdown_coordinator.h"
+#include "core/metrics.h"
 
 // MEMORY LEAK FIX: Forward declaration for FFmpeg buffer cleanup function
 // We'll implement our own version to clean up any leaked buffers
 static void ffmpeg_buffer_cleanup(void);
 
-// Forward declarations for HLS watchdog functions
-static void start_hls_watchdog(void);
-static void stop_hls_watchdog(void);
-
 // MEMORY LEAK FIX: Global variable to track FFmpeg memory usage
 static int ffmpeg_memory_cleanup_registered = 0;
 
@@ -113,12 +111,19 @@ static void global_ffmpeg_cleanup(void) {
 #include "video/hls_writer.h"
 #include "video/stream_protocol.h"
 #include "video/thread_utils.h"
+#include "video/handle_table.h"
 #include "video/timestamp_manager.h"
 #include "video/detection_frame_processing.h"
+#include "video/hls/hls_abr.h"
 #include "video/hls/hls_context.h"
 #include "video/hls/hls_directory.h"
 #include "video/hls/hls_unified_thread.h"
+#include "video/hls/hls_viewers.h"
 #include "video/ffmpeg_utils.h"
+#include "video/stream_ingest.h"
+#include "video/stream_arena.h"
+#include "video/stream_supervisor.h"
+#include "video/reconnect_manager.h"
 
 // Maximum time (in seconds) without receiving a packet before considering the connection dead
 #define MAX_PACKET_TIMEOUT 5
@@ -136,320 +141,84 @@ extern bool go2rtc_get_rtsp_url(const char *stream_name, char *url, size_t url_s
 // Hash map for tracking running HLS streaming contexts
 // These are defined at the bottom of the file as non-static
 
-// CRITICAL FIX: Add tracking for freed contexts to prevent double free and use-after-free
-#define MAX_FREED_CONTEXTS 100
-static void *freed_contexts[MAX_FREED_CONTEXTS] = {0};
-static int freed_contexts_count = 0;
-static pthread_mutex_t freed_contexts_mutex = PTHREAD_MUTEX_INITIALIZER;
-
-// CRITICAL FIX: Add a flag to indicate that a context is pending deletion
-// This helps threads detect when their context is about to be freed
-typedef struct {
-    void *ctx;
-    atomic_int pending_deletion;
-    atomic_int thread_exited;  // Flag to indicate the thread has exited and it's safe to free the context
-} context_deletion_info_t;
+// CRITICAL FIX: Track contexts through generation-counted handles to prevent double free and use-after-free
+// Each context is registered when its thread starts and released right before it is freed.
+// The thread keeps a copy of the handle, so it can tell that its context is gone without
+// touching the context memory, and the checks are lock-free loads on the handle's slot.
+static handle_table_t context_handles;
 
-static context_deletion_info_t pending_deletions[MAX_STREAMS] = {0};
-static pthread_mutex_t pending_deletions_mutex = PTHREAD_MUTEX_INITIALIZER;
+// Handle flags
+#define CTX_FLAG_PENDING_DELETION 0x1  // The context is about to be freed
+#define CTX_FLAG_THREAD_EXITED 0x2     // The thread has exited and it's safe to free the context
 
 // Maximum time to wait for a thread to exit (in microseconds)
 #define MAX_THREAD_EXIT_WAIT_US 2000000  // 2000ms (2 seconds) - increased from 500ms
 
-// CRITICAL FIX: Add memory boundary checking to detect buffer overflows
-#define MEMORY_GUARD_SIZE 16
-#define MEMORY_GUARD_PATTERN 0xFE
-
-// Watchdog thread settings
-#define WATCHDOG_CHECK_INTERVAL_SEC 30  // Check every 30 seconds
-#define WATCHDOG_MAX_RESTART_ATTEMPTS 5  // Maximum number of restart attempts
-#define WATCHDOG_RESTART_COOLDOWN_SEC 300  // 5 minutes between restart attempts
-
-// Function to allocate memory with guard bytes
-static void *safe_malloc(size_t size) {
-    // Allocate extra space for guard bytes
-    size_t total_size = size + (2 * MEMORY_GUARD_SIZE);
-    unsigned char *mem = malloc(total_size);
-
-    if (!mem) {
-        log_error("Failed to allocate memory of size %zu", size);
-        return NULL;
-    }
-
-    // Fill the guard bytes
-    memset(mem, MEMORY_GUARD_PATTERN, MEMORY_GUARD_SIZE);
-    memset(mem + MEMORY_GUARD_SIZE + size, MEMORY_GUARD_PATTERN, MEMORY_GUARD_SIZE);
-
-    // Return the usable portion of the memory
-    return mem + MEMORY_GUARD_SIZE;
-}
-
-// Function to free memory allocated with safe_malloc
-void *safe_free(void *ptr) {
-    if (!ptr) {
-        return NULL;
-    }
-
-    // Get the original pointer
-    unsigned char *mem = ((unsigned char *)ptr) - MEMORY_GUARD_SIZE;
-
-    // Check the guard bytes
-    bool guard_corrupted = false;
-
-    // Check leading guard bytes
-    for (int i = 0; i < MEMORY_GUARD_SIZE; i++) {
-        if (mem[i] != MEMORY_GUARD_PATTERN) {
-            guard_corrupted = true;
-            break;
-        }
-    }
-
-    // We don't know the size of the allocation, so we can't check the trailing guard bytes
-    // This is a limitation of this approach
+// Time without a heartbeat after which the stream supervisor restarts the
+// thread; it beats for every packet, while idle and around reconnection waits
+#define HLS_HEARTBEAT_TIMEOUT_MS (MAX_RECONNECT_DELAY_MS + MAX_PACKET_TIMEOUT * 3 * 1000)
 
-    if (guard_corrupted) {
-        log_error("Memory corruption detected: guard bytes have been overwritten");
-        // Continue with the free anyway
-    }
-
-    // Free the original pointer
-    free(mem);
-
-    return NULL;
+/**
+ * Record that the thread made progress, for the packet timeout and the stream supervisor
+ */
+static void publish_heartbeat(hls_unified_thread_ctx_t *ctx, time_t now) {
+    atomic_store(&ctx->last_packet_time, (int_fast64_t)now);
+    supervisor_beat(ctx->heartbeat);
 }
 
 // Function to check if a context has already been freed
-static bool is_context_already_freed(void *ctx) {
-    if (!ctx) {
-        return false;  // NULL context is not considered freed
-    }
-
-    bool result = false;
-
-    pthread_mutex_lock(&freed_contexts_mutex);
-
-    for (int i = 0; i < freed_contexts_count; i++) {
-        if (freed_contexts[i] == ctx) {
-            result = true;
-            break;
-        }
-    }
-
-    pthread_mutex_unlock(&freed_contexts_mutex);
-
-    // If not found in the freed contexts list, perform additional checks
-    if (!result) {
-        // Check if the memory appears to be invalid
-        // This is a heuristic to detect freed memory
-        bool appears_invalid = false;
-
-        // Try to access the first few bytes to see if they're zeroed out
-        // This might indicate that the memory has been freed
-        unsigned char *ptr = (unsigned char *)ctx;
-        bool all_zeros = true;
-
-        // Use a try/catch-like approach with signal handling to prevent crashes
-        struct sigaction sa_old, sa_new;
-        sigaction(SIGSEGV, NULL, &sa_old);
-        sa_new = sa_old;
-        sa_new.sa_handler = SIG_IGN; // Ignore segmentation fault signal
-        sigaction(SIGSEGV, &sa_new, NULL);
-
-        // Set alarm to prevent hanging if memory is inaccessible
-        alarm(1); // 1 second timeout
-
-        // Check the first few bytes
-        for (int i = 0; i < 16 && i < sizeof(hls_unified_thread_ctx_t); i++) {
-            if (ptr[i] != 0) {
-                all_zeros = false;
-                break;
-            }
-        }
-
-        // Cancel the alarm and restore signal handler
-        alarm(0);
-        sigaction(SIGSEGV, &sa_old, NULL);
-
-        if (all_zeros) {
-            // Memory appears to be zeroed out, which might indicate it's been freed
-            appears_invalid = true;
-        }
-
-        if (appears_invalid) {
-            log_warn("Context %p appears to be invalid or already freed", ctx);
-            result = true;
-        }
-    }
-
-    return result;
+static bool is_context_already_freed(handle_t handle) {
+    return !handle_table_is_valid(&context_handles, handle);
 }
 
 // Function to mark a context as pending deletion
-static void mark_context_pending_deletion(void *ctx) {
-    pthread_mutex_lock(&pending_deletions_mutex);
-
-    // Find an empty slot or the existing entry for this context
-    int slot = -1;
-    for (int i = 0; i < MAX_STREAMS; i++) {
-        if (pending_deletions[i].ctx == ctx) {
-            // Context already marked, just update the flag
-            atomic_store(&pending_deletions[i].pending_deletion, 1);
-            atomic_store(&pending_deletions[i].thread_exited, 0);  // Reset the thread_exited flag
-            slot = i;
-            break;
-        } else if (pending_deletions[i].ctx == NULL && slot == -1) {
-            // Found an empty slot
-            slot = i;
-        }
-    }
-
-    if (slot != -1 && pending_deletions[slot].ctx != ctx) {
-        // Initialize the new entry
-        pending_deletions[slot].ctx = ctx;
-        atomic_init(&pending_deletions[slot].pending_deletion, 1);
-        atomic_init(&pending_deletions[slot].thread_exited, 0);
-    }
-
-    pthread_mutex_unlock(&pending_deletions_mutex);
+static void mark_context_pending_deletion(handle_t handle) {
+    handle_table_set_flags(&context_handles, handle, CTX_FLAG_PENDING_DELETION);
 }
 
 // Function to check if a context is pending deletion
-static bool is_context_pending_deletion(void *ctx) {
-    if (!ctx) {
-        return false;  // NULL context is not considered pending deletion
+static bool is_context_pending_deletion(handle_t handle) {
+    uint32_t flags = 0;
+    if (handle_table_get_flags(&context_handles, handle, &flags) != 0) {
+        return false;  // Freed contexts are reported by is_context_already_freed
     }
-
-    bool result = false;
-
-    pthread_mutex_lock(&pending_deletions_mutex);
-
-    for (int i = 0; i < MAX_STREAMS; i++) {
-        if (pending_deletions[i].ctx == ctx && atomic_load(&pending_deletions[i].pending_deletion)) {
-            result = true;
-            break;
-        }
-    }
-
-    pthread_mutex_unlock(&pending_deletions_mutex);
-
-    return result;
+    return (flags & CTX_FLAG_PENDING_DELETION) != 0;
 }
 
-// Function to mark a thread as exited in the pending deletion list
-static void mark_thread_exited(void *ctx) {
-    if (!ctx) {
-        return;  // Nothing to do for NULL context
-    }
-
-    // CRITICAL FIX: Check if the context is already freed before proceeding
-    // This is a safety check to prevent use-after-free errors
-    if (is_context_already_freed(ctx)) {
-        log_warn("Attempted to mark thread as exited for already freed context %p", ctx);
-        return;
-    }
-
-    pthread_mutex_lock(&pending_deletions_mutex);
-
-    // First, check if the context is already in the list
-    bool found = false;
-    for (int i = 0; i < MAX_STREAMS; i++) {
-        if (pending_deletions[i].ctx == ctx) {
-            atomic_store(&pending_deletions[i].thread_exited, 1);
-            found = true;
-            log_info("Marked thread as exited for context %p", ctx);
-            break;
-        }
-    }
-
-    // If not found, add it to the list
-    if (!found) {
-        // Find an empty slot
-        int slot = -1;
-        for (int i = 0; i < MAX_STREAMS; i++) {
-            if (pending_deletions[i].ctx == NULL) {
-                slot = i;
-                break;
-            }
-        }
-
-        // If we found an empty slot, use it
-        if (slot != -1) {
-            // CRITICAL FIX: Check again if the context is already freed before adding it
-            // This handles the race condition where the context might be freed between our initial check and now
-            if (!is_context_already_freed(ctx)) {
-                pending_deletions[slot].ctx = ctx;
-                atomic_init(&pending_deletions[slot].pending_deletion, 0);
-                atomic_init(&pending_deletions[slot].thread_exited, 1);
-                log_info("Added context %p to pending deletions list and marked thread as exited", ctx);
-            } else {
-                log_warn("Context %p was freed during mark_thread_exited, not adding to list", ctx);
-            }
-        } else {
-            log_warn("No empty slot found in pending deletions list for context %p", ctx);
-        }
+// Function to mark a thread as exited
+static void mark_thread_exited(handle_t handle) {
+    if (handle_table_set_flags(&context_handles, handle, CTX_FLAG_THREAD_EXITED) == 0) {
+        log_info("Marked thread as exited for context handle %" PRIx64, handle);
     }
-
-    pthread_mutex_unlock(&pending_deletions_mutex);
 }
 
 // Function to check if a thread has exited
-static bool has_thread_exited(void *ctx) {
-    bool result = false;
-
-    pthread_mutex_lock(&pending_deletions_mutex);
-
-    for (int i = 0; i < MAX_STREAMS; i++) {
-        if (pending_deletions[i].ctx == ctx) {
-            result = atomic_load(&pending_deletions[i].thread_exited);
-            break;
-        }
+static bool has_thread_exited(handle_t handle) {
+    uint32_t flags = 0;
+    if (handle_table_get_flags(&context_handles, handle, &flags) != 0) {
+        return true;  // The context has been freed, so there is nothing left to wait for
     }
-
-    pthread_mutex_unlock(&pending_deletions_mutex);
-
-    return result;
+    return (flags & CTX_FLAG_THREAD_EXITED) != 0;
 }
 
 // Function to wait for a thread to exit
-static void wait_for_thread_exit(void *ctx) {
-    if (!ctx) {
-        return;  // Nothing to do for NULL context
-    }
-
-    // CRITICAL FIX: Check if the context is already freed before proceeding
-    if (is_context_already_freed(ctx)) {
-        log_warn("Context %p is already freed, skipping thread exit wait", ctx);
-        // Mark as exited anyway to ensure cleanup can proceed
-        mark_thread_exited(ctx);
-        return;
-    }
-
+static void wait_for_thread_exit(handle_t handle) {
     int wait_time = 0;
     const int sleep_interval = 10000;  // 10ms
 
     // First check if the thread has already exited
-    if (has_thread_exited(ctx)) {
-        log_info("Thread for context %p has already exited", ctx);
+    if (has_thread_exited(handle)) {
+        log_info("Thread for context handle %" PRIx64 " has already exited", handle);
         return;
     }
 
-    log_info("Waiting for thread to exit for context %p", ctx);
-
-    // CRITICAL FIX: Add a memory barrier to ensure all previous operations are visible
-    __sync_synchronize();
+    log_info("Waiting for thread to exit for context handle %" PRIx64, handle);
 
     // Wait for the thread to exit with timeout
     while (wait_time < MAX_THREAD_EXIT_WAIT_US) {
-        // CRITICAL FIX: Check if the context is already freed before continuing
-        if (is_context_already_freed(ctx)) {
-            log_warn("Context %p was freed during wait_for_thread_exit", ctx);
-            // Mark as exited anyway to ensure cleanup can proceed
-            mark_thread_exited(ctx);
-            return;
-        }
-
-        if (has_thread_exited(ctx)) {
-            log_info("Thread for context %p has exited after waiting %d ms", ctx, wait_time / 1000);
+        if (has_thread_exited(handle)) {
+            log_info("Thread for context handle %" PRIx64 " has exited after waiting %d ms",
+                    handle, wait_time / 1000);
             return;
         }
 
@@ -458,83 +227,40 @@ static void wait_for_thread_exit(void *ctx) {
 
         // Log progress every 100ms
         if (wait_time % 100000 == 0) {
-            log_info("Still waiting for thread to exit for context %p (%d ms elapsed)", ctx, wait_time / 1000);
-
-            // CRITICAL FIX: Check if the context is pending deletion and re-signal if needed
-            // This handles cases where the thread might have missed the initial signal
-            if (!has_thread_exited(ctx)) {
-                log_info("Re-signaling thread for context %p to exit", ctx);
-                mark_context_pending_deletion(ctx);
-                __sync_synchronize(); // Memory barrier to ensure visibility
-            }
+            log_info("Still waiting for thread to exit for context handle %" PRIx64 " (%d ms elapsed)",
+                    handle, wait_time / 1000);
         }
     }
 
-    log_warn("Timeout waiting for thread to exit for context %p after %d ms", ctx, MAX_THREAD_EXIT_WAIT_US / 1000);
-
-    // CRITICAL FIX: Check if the context is already freed before proceeding
-    if (!is_context_already_freed(ctx)) {
-        // Mark the thread as exited anyway to prevent deadlocks
-        log_warn("Forcing thread exited status for context %p to prevent deadlock", ctx);
-        mark_thread_exited(ctx);
-    } else {
-        log_warn("Context %p was freed during wait_for_thread_exit timeout", ctx);
-    }
+    // Mark the thread as exited anyway to prevent deadlocks; the thread only
+    // checks its handle from now on, so freeing the context is still safe
+    log_warn("Timeout waiting for thread to exit for context handle %" PRIx64 " after %d ms, forcing exited status",
+            handle, MAX_THREAD_EXIT_WAIT_US / 1000);
+    mark_thread_exited(handle);
 }
 
-// Function to clear a context from the pending deletion list
-static void clear_context_pending_deletion(void *ctx) {
-    pthread_mutex_lock(&pending_deletions_mutex);
-
-    for (int i = 0; i < MAX_STREAMS; i++) {
-        if (pending_deletions[i].ctx == ctx) {
-            pending_deletions[i].ctx = NULL;
-            atomic_store(&pending_deletions[i].pending_deletion, 0);
-            atomic_store(&pending_deletions[i].thread_exited, 0);
-            break;
-        }
+// Function to release the handle of a context right before freeing it
+static void release_context_handle(handle_t handle) {
+    if (handle_table_release(&context_handles, handle) == 0) {
+        log_info("Released context handle %" PRIx64, handle);
+    } else {
+        log_warn("Context handle %" PRIx64 " was already released", handle);
     }
-
-    pthread_mutex_unlock(&pending_deletions_mutex);
 }
 
-// Function to mark a context as freed
+// Function to mark a context as freed, for callers that only hold the pointer
 void mark_context_as_freed(void *ctx) {
     if (!ctx) {
         return;  // Nothing to do for NULL context
     }
 
-    pthread_mutex_lock(&freed_contexts_mutex);
-
-    // Check if the context is already in the freed list
-    bool already_freed = false;
-    for (int i = 0; i < freed_contexts_count; i++) {
-        if (freed_contexts[i] == ctx) {
-            already_freed = true;
-            break;
-        }
-    }
-
-    if (already_freed) {
-        log_warn("Context %p is already marked as freed", ctx);
-        pthread_mutex_unlock(&freed_contexts_mutex);
+    handle_t handle = handle_table_find(&context_handles, ctx);
+    if (handle == HANDLE_INVALID) {
+        log_warn("Context %p is not registered or already marked as freed", ctx);
         return;
     }
 
-    // If the array is full, remove the oldest entry
-    if (freed_contexts_count >= MAX_FREED_CONTEXTS) {
-        // Shift all entries down by one
-        for (int i = 0; i < MAX_FREED_CONTEXTS - 1; i++) {
-            freed_contexts[i] = freed_contexts[i + 1];
-        }
-        freed_contexts_count = MAX_FREED_CONTEXTS - 1;
-    }
-
-    // Add the new entry
-    freed_contexts[freed_contexts_count++] = ctx;
-    log_info("Marked context %p as freed", ctx);
-
-    pthread_mutex_unlock(&freed_contexts_mutex);
+    release_context_handle(handle);
 }
 
 /**
@@ -721,148 +447,21 @@ static void safe_cleanup_resources(AVFormatContext **input_ctx, AVPacket **pkt,
 
 /**
  * Calculate reconnection delay with exponential backoff
+ * The reconnect manager stretches it while the camera host is unreachable
+ * and adds jitter.
  *
+ * @param url URL of the stream
  * @param attempt The current reconnection attempt (1-based)
  * @return Delay in milliseconds
  */
-static int calculate_reconnect_delay(int attempt) {
-    if (attempt <= 0) return BASE_RECONNECT_DELAY_MS;
+static int calculate_reconnect_delay(const char *url, int attempt) {
+    if (attempt <= 0) return reconnect_manager_delay(url, BASE_RECONNECT_DELAY_MS);
+    if (attempt > 16) attempt = 16;
 
     // Exponential backoff: delay = base_delay * 2^(attempt-1)
     // Cap at maximum delay
     int delay = BASE_RECONNECT_DELAY_MS * (1 << (attempt - 1));
-    return (delay < MAX_RECONNECT_DELAY_MS) ? delay : MAX_RECONNECT_DELAY_MS;
-}
-
-/**
- * Check RTSP connection by sending an OPTIONS request
- *
- * @param rtsp_url The RTSP URL to check
- * @param host Buffer to store the extracted hostname
- * @param port Pointer to store the extracted port
- * @return 0 on success, negative on error
- */
-static int check_rtsp_connection(const char *rtsp_url, char *host, int *port) {
-    if (!rtsp_url || !host || !port || strncmp(rtsp_url, "rtsp://", 7) != 0) {
-        return -1;
-    }
-
-    // Skip the rtsp:// prefix
-    const char *host_start = rtsp_url + 7;
-
-    // Skip any authentication info (user:pass@)
-    const char *at_sign = strchr(host_start, '@');
-    if (at_sign) {
-        host_start = at_sign + 1;
-    }
-
-    // Find the end of the host part
-    const char *host_end = strchr(host_start, ':');
-    if (!host_end) {
-        host_end = strchr(host_start, '/');
-        if (!host_end) {
-            host_end = host_start + strlen(host_start);
-        }
-    }
-
-    // Copy the host part with bounds checking
-    size_t host_len = host_end - host_start;
-    if (host_len >= 256) {
-        host_len = 255;
-    }
-    if (host_len == 0) {
-        // Empty hostname
-        return -1;
-    }
-    memcpy(host, host_start, host_len);
-    host[host_len] = '\0';
-
-    // Extract the port if specified
-    *port = 554; // Default RTSP port
-    if (*host_end == ':') {
-        const char *port_start = host_end + 1;
-        char *port_end;
-        long port_val = strtol(port_start, &port_end, 10);
-        if (port_start == port_end || port_val <= 0 || port_val > 65535) {
-            *port = 554; // Invalid port, use default
-        } else {
-            *port = (int)port_val;
-        }
-    }
-
-    // Create a socket with error handling
-    int sock = socket(AF_INET, SOCK_STREAM, 0);
-    if (sock < 0) {
-        log_error("Failed to create socket for RTSP connection check: %s", strerror(errno));
-        return -1;
-    }
-
-    // Set a short timeout for the connection
-    struct timeval tv;
-    tv.tv_sec = 1;
-    tv.tv_usec = 0;
-    if (setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0 ||
-        setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv)) < 0) {
-        log_warn("Failed to set socket timeout: %s", strerror(errno));
-        // Continue anyway
-    }
-
-    // Connect to the server
-    struct sockaddr_in server_addr;
-    memset(&server_addr, 0, sizeof(server_addr));
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(*port);
-
-    // Convert hostname to IP address
-    struct hostent *he = gethostbyname(host);
-    if (!he) {
-        close(sock);
-        return -1;
-    }
-
-    memcpy(&server_addr.sin_addr, he->h_addr_list[0], he->h_length);
-
-    // Connect to the server
-    if (connect(sock, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
-        close(sock);
-        return -1;
-    }
-
-    // Extract the path part of the URL
-    const char *path = strchr(host_start, '/');
-    if (!path) {
-        path = "/";
-    }
-
-    // Send a simple RTSP OPTIONS request
-    char request[1024];
-    snprintf(request, sizeof(request),
-             "OPTIONS %s RTSP/1.0\r\n"
-             "CSeq: 1\r\n"
-             "User-Agent: LightNVR\r\n"
-             "\r\n",
-             path);
-
-    if (send(sock, request, strlen(request), 0) < 0) {
-        close(sock);
-        return -1;
-    }
-
-    // Receive the response
-    char response[1024] = {0};
-    int bytes_received = recv(sock, response, sizeof(response) - 1, 0);
-    close(sock);
-
-    if (bytes_received <= 0) {
-        return -1;
-    }
-
-    // Check if the response contains "404 Not Found"
-    if (strstr(response, "404 Not Found") != NULL) {
-        return -1;
-    }
-
-    return 0;
+    return reconnect_manager_delay(url, (delay < MAX_RECONNECT_DELAY_MS) ? delay : MAX_RECONNECT_DELAY_MS);
 }
 
 /**
@@ -879,6 +478,8 @@ void *hls_unified_thread_func(void *arg) {
     int reconnect_attempt = 0;
     int reconnect_delay_ms = BASE_RECONNECT_DELAY_MS;
     time_t last_packet_time = 0;
+    stream_ingest_consumer_t *ingest_consumer = NULL;
+    bool use_shared_ingest = stream_ingest_enabled();
 
     // Validate context
     if (!ctx) {
@@ -886,8 +487,12 @@ void *hls_unified_thread_func(void *arg) {
         return NULL;
     }
 
+    // Keep a copy of the handle; once it is released, ctx must no longer be touched
+    handle_t handle = ctx->handle;
+    thread_set_identity(THREAD_CLASS_HLS, "hls", ctx->stream_name);
+
     // Check if the context is already marked for deletion
-    if (is_context_pending_deletion(ctx)) {
+    if (is_context_pending_deletion(handle)) {
         log_warn("Context is already marked for deletion, exiting thread");
         return NULL;
     }
@@ -913,6 +518,20 @@ void *hls_unified_thread_func(void *arg) {
 
     log_info("Starting unified HLS thread for stream %s", stream_name);
 
+    // Without the shared ingest this thread owns the camera connection and
+    // feeds the ingest counters itself
+    metric_t frames_metric = 0;
+    metric_t bytes_metric = 0;
+    metric_t reconnects_metric = 0;
+    if (!use_shared_ingest) {
+        frames_metric = metrics_counter("lightnvr_ingest_video_frames_total",
+                                        "Video frames read from the camera", "stream", stream_name, NULL);
+        bytes_metric = metrics_counter("lightnvr_ingest_bytes_total",
+                                       "Bytes read from the camera", "stream", stream_name, NULL);
+        reconnects_metric = metrics_counter("lightnvr_stream_reconnects_total",
+                                            "Reconnections to the camera", "stream", stream_name, NULL);
+    }
+
     // Check if we're still running before proceeding
     if (!atomic_load(&ctx->running)) {
         log_warn("Unified HLS thread for %s started but already marked as not running", stream_name);
@@ -930,7 +549,7 @@ void *hls_unified_thread_func(void *arg) {
     // Register with shutdown coordinator
     char component_name[128];
     snprintf(component_name, sizeof(component_name), "hls_unified_%s", stream_name);
-    ctx->shutdown_component_id = register_component(component_name, COMPONENT_HLS_WRITER, ctx, 60);
+    ctx->shutdown_component_id = register_component(component_name, COMPONENT_HLS_WRITER, ctx, COMPONENT_PRIORITY_HLS);
     if (ctx->shutdown_component_id >= 0) {
         log_info("Registered unified HLS thread %s with shutdown coordinator (ID: %d)",
                 stream_name, ctx->shutdown_component_id);
@@ -960,7 +579,7 @@ void *hls_unified_thread_func(void *arg) {
     }
 
     // Create HLS writer with 5-second segments
-    ctx->writer = hls_writer_create(ctx->output_path, stream_name, 5);
+    ctx->writer = hls_writer_create(ctx->output_path, stream_name, 5, ctx->segment_format);
     if (!ctx->writer) {
         log_error("Failed to create HLS writer for %s", stream_name);
 
@@ -977,34 +596,41 @@ void *hls_unified_thread_func(void *arg) {
         return NULL;
     }
 
+    if (ctx->record_segments) {
+        ctx->writer->recording = hls_recording_create(stream_name, ctx->recording_duration);
+    }
+
     // Store the HLS writer in the stream state for other components to access
     if (state) {
         state->hls_ctx = ctx->writer;
     }
 
+    // On-demand streams count their viewers from here on
+    bool on_demand = ctx->on_demand && use_shared_ingest && hls_viewers_register(stream_name) == 0;
+
     // CRITICAL FIX: Add a local copy of the context pointer for safety checks
     hls_unified_thread_ctx_t *ctx_safe = ctx;
 
     // Main state machine loop
-    while (ctx && ctx_safe && !is_context_already_freed(ctx_safe) && !is_context_pending_deletion(ctx_safe)) {
+    while (ctx && ctx_safe && !is_context_already_freed(handle) && !is_context_pending_deletion(handle)) {
         // CRITICAL FIX: Update the safe context pointer for this iteration
         ctx_safe = ctx;
 
         // Check if we should continue running
         // CRITICAL FIX: Only access ctx members if the context is not already freed
-        if (!ctx_safe || is_context_already_freed(ctx_safe) || is_context_pending_deletion(ctx_safe) ||
+        if (!ctx_safe || is_context_already_freed(handle) || is_context_pending_deletion(handle) ||
             (ctx_safe && !atomic_load(&ctx_safe->running))) {
             log_info("Unified HLS thread for %s stopping due to %s",
                     stream_name,
                     !ctx_safe ? "context is NULL" :
-                    is_context_already_freed(ctx_safe) ? "context already freed" :
-                    is_context_pending_deletion(ctx_safe) ? "context pending deletion" :
+                    is_context_already_freed(handle) ? "context already freed" :
+                    is_context_pending_deletion(handle) ? "context pending deletion" :
                     "running flag cleared");
             break;
         }
         // Update thread state in context
         // CRITICAL FIX: Only update if context is still valid
-        if (ctx_safe && !is_context_already_freed(ctx_safe) && !is_context_pending_deletion(ctx_safe)) {
+        if (ctx_safe && !is_context_already_freed(handle) && !is_context_pending_deletion(handle)) {
             atomic_store(&ctx_safe->thread_state, thread_state);
         }
 
@@ -1035,18 +661,64 @@ void *hls_unified_thread_func(void *arg) {
                 break;
 
             case HLS_THREAD_CONNECTING:
-                log_info("Connecting to stream %s (attempt %d)", stream_name, reconnect_attempt + 1);
+                log_info_ratelimited("Connecting to stream %s (attempt %d)", stream_name, reconnect_attempt + 1);
 
                 // Close any existing connection first
                 safe_cleanup_resources(&input_ctx, NULL, NULL);
 
-                // Check if the RTSP URL exists before trying to connect
+                // With the shared ingest the camera connection is owned (and reconnected)
+                // by the ingest thread; we only attach as a consumer
+                if (use_shared_ingest) {
+                    if (!ingest_consumer) {
+                        // Start from the ingest's newest GOP instead of waiting for the next key frame
+                        ingest_consumer = stream_ingest_attach_with_gop(stream_name, ctx->rtsp_url, ctx->protocol,
+                                                                        "hls", 0, true);
+                        if (!ingest_consumer) {
+                            reconnect_attempt++;
+                            reconnect_delay_ms = calculate_reconnect_delay(ctx->rtsp_url, reconnect_attempt);
+                            log_error_ratelimited("Failed to attach HLS writer for %s to shared ingest, retrying in %d ms",
+                                     stream_name, reconnect_delay_ms);
+                            av_usleep(reconnect_delay_ms * 1000);
+                            break;
+                        }
+                    }
+
+                    // Stay in CONNECTING until the ingest has opened the camera
+                    if (stream_ingest_wait_for_streams(ingest_consumer, 1000) != 0) {
+                        atomic_store(&ctx->connection_valid, 0);
+                        break;
+                    }
+
+                    video_stream_idx = stream_ingest_get_video_stream_index(ingest_consumer);
+                    AVFormatContext *ingest_fmt = stream_ingest_get_format_context(ingest_consumer);
+                    if (video_stream_idx < 0 || !ingest_fmt || !ctx->writer ||
+                        hls_writer_initialize(ctx->writer, ingest_fmt->streams[video_stream_idx]) < 0) {
+                        log_error("Failed to initialize HLS writer for stream %s from shared ingest", stream_name);
+                        reconnect_attempt++;
+                        av_usleep(calculate_reconnect_delay(ctx->rtsp_url, reconnect_attempt) * 1000);
+                        break;
+                    }
+
+                    log_info("HLS writer for stream %s attached to shared ingest", stream_name);
+                    thread_state = HLS_THREAD_RUNNING;
+                    reconnect_attempt = 0;
+                    atomic_store(&ctx->connection_valid, 1);
+                    atomic_store(&ctx->consecutive_failures, 0);
+                    last_packet_time = time(NULL);
+                    publish_heartbeat(ctx, last_packet_time);
+                    break;
+                }
+
+                // Check that the camera host answers before trying to connect; the
+                // probe is shared with the other streams of the same host
                 if (strncmp(ctx->rtsp_url, "rtsp://", 7) == 0) {
                     char host[256] = {0};
                     int port = 554; // Default RTSP port
+                    int release_ms = 0;
 
-                    if (check_rtsp_connection(ctx->rtsp_url, host, &port) < 0) {
-                        log_error("Failed to connect to RTSP server: %s:%d", host, port);
+                    if (!reconnect_manager_probe(ctx->rtsp_url, &release_ms)) {
+                        reconnect_manager_host(ctx->rtsp_url, host, sizeof(host), &port);
+                        log_error_ratelimited("Failed to connect to RTSP server: %s:%d", host, port);
 
                         // Mark connection as invalid
                         atomic_store(&ctx->connection_valid, 0);
@@ -1055,22 +727,22 @@ void *hls_unified_thread_func(void *arg) {
                         reconnect_attempt++;
 
                         // Calculate reconnection delay with exponential backoff
-                        reconnect_delay_ms = calculate_reconnect_delay(reconnect_attempt);
+                        reconnect_delay_ms = calculate_reconnect_delay(ctx->rtsp_url, reconnect_attempt);
 
-                        log_info("Will retry connection to stream %s in %d ms (attempt %d)",
+                        log_info_ratelimited("Will retry connection to stream %s in %d ms (attempt %d)",
                                 stream_name, reconnect_delay_ms, reconnect_attempt + 1);
 
                         // Sleep before retrying
                         av_usleep(reconnect_delay_ms * 1000);
 
                         // CRITICAL FIX: Check for shutdown conditions before continuing
-                        if (is_context_already_freed(ctx) || is_context_pending_deletion(ctx) ||
+                        if (is_context_already_freed(handle) || is_context_pending_deletion(handle) ||
                             !atomic_load(&ctx->running) || is_shutdown_initiated() ||
                             (state && (is_stream_state_stopping(state) || !are_stream_callbacks_enabled(state)))) {
                             log_info("Unified HLS thread for %s stopping during connection attempt due to %s",
                                     stream_name,
-                                    is_context_already_freed(ctx) ? "context already freed" :
-                                    is_context_pending_deletion(ctx) ? "context pending deletion" :
+                                    is_context_already_freed(handle) ? "context already freed" :
+                                    is_context_pending_deletion(handle) ? "context pending deletion" :
                                     !atomic_load(&ctx->running) ? "running flag cleared" :
                                     is_shutdown_initiated() ? "system shutdown" :
                                     is_stream_state_stopping(state) ? "stream state STOPPING" :
@@ -1082,6 +754,13 @@ void *hls_unified_thread_func(void *arg) {
                         // Stay in CONNECTING state and try again
                         break;
                     }
+
+                    // The host just came back, wait for this stream's turn
+                    if (release_ms > 0) {
+                        supervisor_beat(ctx->heartbeat);
+                        av_usleep(release_ms * 1000);
+                        supervisor_beat(ctx->heartbeat);
+                    }
                 }
 
                 // CRITICAL FIX: Check for shutdown before opening the stream
@@ -1093,7 +772,7 @@ void *hls_unified_thread_func(void *arg) {
                 }
 
                 // CRITICAL FIX: Check if context is still valid before accessing
-                if (!ctx || is_context_pending_deletion(ctx) || is_context_already_freed(ctx)) {
+                if (!ctx || is_context_pending_deletion(handle) || is_context_already_freed(handle)) {
                     log_warn("Context for stream %s is no longer valid, skipping connection attempt", stream_name);
                     thread_state = HLS_THREAD_STOPPING;
                     break;
@@ -1128,7 +807,7 @@ void *hls_unified_thread_func(void *arg) {
                     av_strerror(ret, error_buf, AV_ERROR_MAX_STRING_SIZE);
 
                     // Log the error but don't treat any error type specially
-                    log_error("Failed to connect to stream %s: %s (error code: %d)",
+                    log_error_ratelimited("Failed to connect to stream %s: %s (error code: %d)",
                              stream_name, error_buf, ret);
 
                     // MEMORY LEAK FIX: Use comprehensive cleanup instead of just avformat_close_input
@@ -1159,7 +838,7 @@ void *hls_unified_thread_func(void *arg) {
                     }
 
                     // CRITICAL FIX: Check if context is still valid before accessing
-                    if (ctx && !is_context_pending_deletion(ctx) && !is_context_already_freed(ctx)) {
+                    if (ctx && !is_context_pending_deletion(handle) && !is_context_already_freed(handle)) {
                         // Mark connection as invalid
                         atomic_store(&ctx->connection_valid, 0);
                     } else {
@@ -1173,14 +852,14 @@ void *hls_unified_thread_func(void *arg) {
                     reconnect_attempt++;
 
                     // Calculate reconnection delay with exponential backoff
-                    reconnect_delay_ms = calculate_reconnect_delay(reconnect_attempt);
+                    reconnect_delay_ms = calculate_reconnect_delay(ctx->rtsp_url, reconnect_attempt);
 
                     // Cap reconnection attempts to avoid integer overflow
                     if (reconnect_attempt > 1000) {
                         reconnect_attempt = 1000;
                     }
 
-                    log_info("Will retry connection to stream %s in %d ms (attempt %d)",
+                    log_info_ratelimited("Will retry connection to stream %s in %d ms (attempt %d)",
                             stream_name, reconnect_delay_ms, reconnect_attempt + 1);
 
                     // Sleep before retrying
@@ -1193,7 +872,7 @@ void *hls_unified_thread_func(void *arg) {
                 // Find video stream
                 video_stream_idx = find_video_stream_index(input_ctx);
                 if (video_stream_idx == -1) {
-                    log_error("No video stream found in %s", ctx->rtsp_url);
+                    log_error_ratelimited("No video stream found in %s", ctx->rtsp_url);
 
                     // MEMORY LEAK FIX: Use comprehensive cleanup instead of just avformat_close_input
                     comprehensive_ffmpeg_cleanup(&input_ctx, NULL, NULL, NULL);
@@ -1205,27 +884,27 @@ void *hls_unified_thread_func(void *arg) {
                     reconnect_attempt++;
 
                     // Calculate reconnection delay with exponential backoff
-                    reconnect_delay_ms = calculate_reconnect_delay(reconnect_attempt);
+                    reconnect_delay_ms = calculate_reconnect_delay(ctx->rtsp_url, reconnect_attempt);
 
                     // Cap reconnection attempts to avoid integer overflow
                     if (reconnect_attempt > 1000) {
                         reconnect_attempt = 1000;
                     }
 
-                    log_info("Will retry connection to stream %s in %d ms (attempt %d)",
+                    log_info_ratelimited("Will retry connection to stream %s in %d ms (attempt %d)",
                             stream_name, reconnect_delay_ms, reconnect_attempt + 1);
 
                     // Sleep before retrying
                     av_usleep(reconnect_delay_ms * 1000);
 
                     // CRITICAL FIX: Check for shutdown conditions before continuing
-                    if (is_context_already_freed(ctx) || is_context_pending_deletion(ctx) ||
+                    if (is_context_already_freed(handle) || is_context_pending_deletion(handle) ||
                         !atomic_load(&ctx->running) || is_shutdown_initiated() ||
                         (state && (is_stream_state_stopping(state) || !are_stream_callbacks_enabled(state)))) {
                         log_info("Unified HLS thread for %s stopping during connection attempt due to %s",
                                 stream_name,
-                                is_context_already_freed(ctx) ? "context already freed" :
-                                is_context_pending_deletion(ctx) ? "context pending deletion" :
+                                is_context_already_freed(handle) ? "context already freed" :
+                                is_context_pending_deletion(handle) ? "context pending deletion" :
                                 !atomic_load(&ctx->running) ? "running flag cleared" :
                                 is_shutdown_initiated() ? "system shutdown" :
                                 is_stream_state_stopping(state) ? "stream state STOPPING" :
@@ -1259,7 +938,7 @@ void *hls_unified_thread_func(void *arg) {
                 // Initialize HLS writer with stream information
                 if (!is_shutdown_initiated() && input_ctx->streams[video_stream_idx]) {
                     // CRITICAL FIX: Check if context is still valid before accessing
-                    if (ctx && !is_context_pending_deletion(ctx) && !is_context_already_freed(ctx) && ctx->writer) {
+                    if (ctx && !is_context_pending_deletion(handle) && !is_context_already_freed(handle) && ctx->writer) {
                         ret = hls_writer_initialize(ctx->writer, input_ctx->streams[video_stream_idx]);
                     } else {
                         log_warn("Context for stream %s is no longer valid or writer is NULL, skipping HLS writer initialization", stream_name);
@@ -1274,7 +953,7 @@ void *hls_unified_thread_func(void *arg) {
                         comprehensive_ffmpeg_cleanup(&input_ctx, NULL, NULL, NULL);
 
                         // CRITICAL FIX: Check if context is still valid before accessing
-                        if (ctx && !is_context_pending_deletion(ctx) && !is_context_already_freed(ctx)) {
+                        if (ctx && !is_context_pending_deletion(handle) && !is_context_already_freed(handle)) {
                             // Mark connection as invalid
                             atomic_store(&ctx->connection_valid, 0);
                         } else {
@@ -1288,22 +967,22 @@ void *hls_unified_thread_func(void *arg) {
                         reconnect_attempt++;
 
                         // Calculate reconnection delay with exponential backoff
-                        reconnect_delay_ms = calculate_reconnect_delay(reconnect_attempt);
+                        reconnect_delay_ms = calculate_reconnect_delay(ctx->rtsp_url, reconnect_attempt);
 
-                        log_info("Will retry connection to stream %s in %d ms (attempt %d)",
+                        log_info_ratelimited("Will retry connection to stream %s in %d ms (attempt %d)",
                                 stream_name, reconnect_delay_ms, reconnect_attempt + 1);
 
                         // Sleep before retrying
                         av_usleep(reconnect_delay_ms * 1000);
 
                         // CRITICAL FIX: Check for shutdown conditions before continuing
-                        if (is_context_already_freed(ctx) || is_context_pending_deletion(ctx) ||
+                        if (is_context_already_freed(handle) || is_context_pending_deletion(handle) ||
                             !atomic_load(&ctx->running) || is_shutdown_initiated() ||
                             (state && (is_stream_state_stopping(state) || !are_stream_callbacks_enabled(state)))) {
                             log_info("Unified HLS thread for %s stopping during connection attempt due to %s",
                                     stream_name,
-                                    is_context_already_freed(ctx) ? "context already freed" :
-                                    is_context_pending_deletion(ctx) ? "context pending deletion" :
+                                    is_context_already_freed(handle) ? "context already freed" :
+                                    is_context_pending_deletion(handle) ? "context pending deletion" :
                                     !atomic_load(&ctx->running) ? "running flag cleared" :
                                     is_shutdown_initiated() ? "system shutdown" :
                                     is_stream_state_stopping(state) ? "stream state STOPPING" :
@@ -1323,7 +1002,7 @@ void *hls_unified_thread_func(void *arg) {
                 reconnect_attempt = 0;
 
                 // CRITICAL FIX: Check if context is still valid before accessing
-                if (is_context_already_freed(ctx) || is_context_pending_deletion(ctx)) {
+                if (is_context_already_freed(handle) || is_context_pending_deletion(handle)) {
                     log_warn("Context for stream %s is no longer valid, exiting thread", stream_name);
                     thread_state = HLS_THREAD_STOPPING;
                     break;
@@ -1332,13 +1011,13 @@ void *hls_unified_thread_func(void *arg) {
                 atomic_store(&ctx->connection_valid, 1);
                 atomic_store(&ctx->consecutive_failures, 0);
                 last_packet_time = time(NULL);
-                atomic_store(&ctx->last_packet_time, (int_fast64_t)last_packet_time);
+                publish_heartbeat(ctx, last_packet_time);
                 break;
 
             case HLS_THREAD_RUNNING:
                 // Check if we should exit before potentially blocking on av_read_frame
                 // CRITICAL FIX: Check if context is still valid before accessing
-                if (is_context_already_freed(ctx) || is_context_pending_deletion(ctx)) {
+                if (is_context_already_freed(handle) || is_context_pending_deletion(handle)) {
                     log_warn("Context for stream %s is no longer valid, exiting thread", stream_name);
                     thread_state = HLS_THREAD_STOPPING;
                     break;
@@ -1350,15 +1029,72 @@ void *hls_unified_thread_func(void *arg) {
                     break;
                 }
 
+                // Nobody watched for a while: stop writing until the next request
+                if (on_demand && !hls_viewers_active(stream_name, g_config.hls_idle_timeout)) {
+                    log_info("No HLS viewers for stream %s in %d seconds, going idle",
+                             stream_name, g_config.hls_idle_timeout);
+
+                    // Detach first, so the ingest can stop if nothing else consumes it
+                    if (ingest_consumer) {
+                        stream_ingest_detach(ingest_consumer);
+                        ingest_consumer = NULL;
+                    }
+
+                    hls_writer_t *idle_writer = __atomic_exchange_n(&ctx->writer, NULL, __ATOMIC_SEQ_CST);
+                    if (state && state->hls_ctx == idle_writer) {
+                        state->hls_ctx = NULL;
+                    }
+                    if (idle_writer) {
+                        hls_writer_close(idle_writer);
+                    }
+                    clear_stream_hls_segments(stream_name);
+
+                    video_stream_idx = -1;
+                    thread_state = HLS_THREAD_IDLE;
+                    break;
+                }
+
                 // Read packet
-                ret = av_read_frame(input_ctx, pkt);
+                if (ingest_consumer) {
+                    ret = stream_ingest_read_packet(ingest_consumer, pkt, 1000);
+
+                    if (ret == STREAM_INGEST_STREAMS_CHANGED) {
+                        video_stream_idx = stream_ingest_get_video_stream_index(ingest_consumer);
+                        log_info("Input streams changed for stream %s after ingest reconnect", stream_name);
+                        break;
+                    }
+
+                    if (ret == AVERROR(EAGAIN)) {
+                        // The ingest reconnects on its own; just report the stall
+                        time_t now = time(NULL);
+                        if (now - last_packet_time > MAX_PACKET_TIMEOUT && atomic_load(&ctx->connection_valid)) {
+                            log_warn("No packets from shared ingest for stream %s for %ld seconds",
+                                    stream_name, (long)(now - last_packet_time));
+                            atomic_store(&ctx->connection_valid, 0);
+                            atomic_fetch_add(&ctx->consecutive_failures, 1);
+                        }
+                        break;
+                    }
+
+                    if (ret < 0) {
+                        log_info("Shared ingest for stream %s ended, stopping HLS thread", stream_name);
+                        thread_state = HLS_THREAD_STOPPING;
+                        break;
+                    }
+                } else {
+                    ret = av_read_frame(input_ctx, pkt);
+                }
+
+                // Packets from the shared ingest are described by its shadow context
+                AVFormatContext *packet_src = ingest_consumer ?
+                    stream_ingest_get_format_context(ingest_consumer) : input_ctx;
 
                 if (ret < 0) {
                     // Handle read errors
                     char error_buf[AV_ERROR_MAX_STRING_SIZE] = {0};
                     av_strerror(ret, error_buf, AV_ERROR_MAX_STRING_SIZE);
 
-                    log_error("Error reading from stream %s: %s (code: %d)",
+                    log_error_ratelimited("Error reading from stream %s: %s (code: %d)",
                              stream_name, error_buf, ret);
 
                     // Unref packet before reconnecting
@@ -1374,27 +1110,34 @@ void *hls_unified_thread_func(void *arg) {
 
                 // Get the stream for this packet
                 AVStream *input_stream = NULL;
-                if (pkt->stream_index >= 0 && pkt->stream_index < input_ctx->nb_streams) {
-                    input_stream = input_ctx->streams[pkt->stream_index];
+                if (packet_src && pkt->stream_index >= 0 && pkt->stream_index < packet_src->nb_streams) {
+                    input_stream = packet_src->streams[pkt->stream_index];
                 } else {
-                    log_warn("Invalid stream index %d for stream %s", pkt->stream_index, stream_name);
+                    log_warn_ratelimited("Invalid stream index %d for stream %s", pkt->stream_index, stream_name);
                     av_packet_unref(pkt);
                     continue;
                 }
 
                 // Validate packet data
                 if (!pkt->data || pkt->size <= 0) {
-                    log_warn("Invalid packet (null data or zero size) for stream %s", stream_name);
+                    log_warn_ratelimited("Invalid packet (null data or zero size) for stream %s", stream_name);
                     av_packet_unref(pkt);
                     continue;
                 }
 
+                if (!ingest_consumer) {
+                    metrics_add(bytes_metric, (uint64_t)pkt->size);
+                    if (pkt->stream_index == video_stream_idx) {
+                        metrics_add(frames_metric, 1);
+                    }
+                }
+
                 // Process packets based on stream type
                 if (pkt->stream_index == video_stream_idx) {
                     // This is a video packet - process it
 
                     // CRITICAL FIX: Check if context is still valid before accessing
-                    if (!ctx || is_context_pending_deletion(ctx) || is_context_already_freed(ctx)) {
+                    if (!ctx || is_context_pending_deletion(handle) || is_context_already_freed(handle)) {
                         log_warn("Context for stream %s is no longer valid, skipping packet and exiting thread", stream_name);
                         thread_state = HLS_THREAD_STOPPING;
                         break;
@@ -1403,7 +1146,7 @@ void *hls_unified_thread_func(void *arg) {
                     // CRITICAL FIX: Check if writer is NULL before accessing it
                     // This prevents segmentation fault during shutdown
                     if (!ctx->writer) {
-                        log_warn("Writer is NULL for stream %s during packet processing, skipping packet", stream_name);
+                        log_warn_ratelimited("Writer is NULL for stream %s during packet processing, skipping packet", stream_name);
                         continue;
                     }
 
@@ -1415,7 +1158,7 @@ void *hls_unified_thread_func(void *arg) {
 
                     // Check again after memory barrier
                     if (!writer) {
-                        log_warn("Writer became NULL for stream %s after memory barrier, skipping packet", stream_name);
+                        log_warn_ratelimited("Writer became NULL for stream %s after memory barrier, skipping packet", stream_name);
                         continue;
                     }
 
@@ -1424,28 +1167,34 @@ void *hls_unified_thread_func(void *arg) {
 
                     // CRITICAL FIX: Check if writer is still valid after locking
                     if (ctx->writer != writer) {
-                        log_warn("Writer changed for stream %s during mutex lock, releasing mutex and skipping packet", stream_name);
+                        log_warn_ratelimited("Writer changed for stream %s during mutex lock, releasing mutex and skipping packet", stream_name);
                         pthread_mutex_unlock(&writer->mutex);
                         continue;
                     }
 
+                    // Packets read directly from the camera are not traced
+                    if (ingest_consumer) {
+                        writer->packet_trace = ingest_consumer->trace;
+                    } else {
+                        memset(&writer->packet_trace, 0, sizeof(writer->packet_trace));
+                    }
                     ret = hls_writer_write_packet(writer, pkt, input_stream);
 
                     // Log key frames for debugging
                     bool is_key_frame = (pkt->flags & AV_PKT_FLAG_KEY) != 0;
                     if (is_key_frame && ret >= 0) {
-                        log_debug("Processed video key frame for stream %s", stream_name);
+                        log_debug_ratelimited("Processed video key frame for stream %s", stream_name);
                     }
 
                     // Handle write errors
                     if (ret < 0) {
                         char error_buf[AV_ERROR_MAX_STRING_SIZE] = {0};
                         av_strerror(ret, error_buf, AV_ERROR_MAX_STRING_SIZE);
-                        log_warn("Error writing video packet to HLS for stream %s: %s", stream_name, error_buf);
+                        log_warn_ratelimited("Error writing video packet to HLS for stream %s: %s", stream_name, error_buf);
                     } else {
                         // Successfully processed a packet
                         last_packet_time = time(NULL);
-                        atomic_store(&ctx->last_packet_time, (int_fast64_t)last_packet_time);
+                        publish_heartbeat(ctx, last_packet_time);
                         atomic_store(&ctx->consecutive_failures, 0);
                         atomic_store(&ctx->connection_valid, 1);
                     }
@@ -1456,19 +1205,19 @@ void *hls_unified_thread_func(void *arg) {
                     // This is a non-video packet (likely audio)
                     // For now, we'll just log it and skip processing
                     // This prevents the "Invalid packet stream index" errors
-                    if (pkt->stream_index >= 0 && pkt->stream_index < input_ctx->nb_streams) {
-                        AVStream *stream = input_ctx->streams[pkt->stream_index];
+                    if (pkt->stream_index >= 0 && pkt->stream_index < packet_src->nb_streams) {
+                        AVStream *stream = packet_src->streams[pkt->stream_index];
                         AVCodecParameters *codecpar = stream->codecpar;
 
                         if (codecpar->codec_type == AVMEDIA_TYPE_AUDIO) {
-                            log_debug("Skipping audio packet for stream %s (stream index: %d)",
+                            log_debug_ratelimited("Skipping audio packet for stream %s (stream index: %d)",
                                     stream_name, pkt->stream_index);
                         } else {
-                            log_debug("Skipping non-video packet for stream %s (stream index: %d, type: %d)",
+                            log_debug_ratelimited("Skipping non-video packet for stream %s (stream index: %d, type: %d)",
                                     stream_name, pkt->stream_index, codecpar->codec_type);
                         }
                     } else {
-                        log_warn("Skipping packet with invalid stream index %d for stream %s",
+                        log_warn_ratelimited("Skipping packet with invalid stream index %d for stream %s",
                                 pkt->stream_index, stream_name);
                     }
                 }
@@ -1478,14 +1227,14 @@ void *hls_unified_thread_func(void *arg) {
 
                 // Check if we haven't received a packet in a while
                 time_t now = time(NULL);
-                if (now - last_packet_time > MAX_PACKET_TIMEOUT) {
+                if (!ingest_consumer && now - last_packet_time > MAX_PACKET_TIMEOUT) {
                     log_error("No packets received from stream %s for %ld seconds, reconnecting",
                              stream_name, now - last_packet_time);
                     thread_state = HLS_THREAD_RECONNECTING;
                     reconnect_attempt = 1;
 
                     // CRITICAL FIX: Check if context is still valid before accessing
-                    if (ctx && !is_context_pending_deletion(ctx) && !is_context_already_freed(ctx)) {
+                    if (ctx && !is_context_pending_deletion(handle) && !is_context_already_freed(handle)) {
                         atomic_store(&ctx->connection_valid, 0);
                         atomic_fetch_add(&ctx->consecutive_failures, 1);
                     } else {
@@ -1497,21 +1246,29 @@ void *hls_unified_thread_func(void *arg) {
                 break;
 
             case HLS_THREAD_RECONNECTING:
-                log_info("Reconnecting to stream %s (attempt %d)", stream_name, reconnect_attempt);
+                // Reconnection of the camera is handled by the shared ingest itself
+                if (ingest_consumer) {
+                    thread_state = HLS_THREAD_RUNNING;
+                    break;
+                }
+
+                log_info_ratelimited("Reconnecting to stream %s (attempt %d)", stream_name, reconnect_attempt);
 
                 // Close existing connection
                 safe_cleanup_resources(&input_ctx, NULL, NULL);
 
                 // Calculate reconnection delay with exponential backoff
-                reconnect_delay_ms = calculate_reconnect_delay(reconnect_attempt);
+                reconnect_delay_ms = calculate_reconnect_delay(ctx->rtsp_url, reconnect_attempt);
 
-                // Sleep before reconnecting
-                log_info("Waiting %d ms before reconnecting to stream %s", reconnect_delay_ms, stream_name);
+                // Sleep before reconnecting; the thread is alive, so it keeps beating
+                log_info_ratelimited("Waiting %d ms before reconnecting to stream %s", reconnect_delay_ms, stream_name);
+                supervisor_beat(ctx->heartbeat);
                 av_usleep(reconnect_delay_ms * 1000);
+                supervisor_beat(ctx->heartbeat);
 
                 // Check if we should stop during the sleep
                 // CRITICAL FIX: Check if context is still valid before accessing
-                if (is_context_already_freed(ctx) || is_context_pending_deletion(ctx)) {
+                if (is_context_already_freed(handle) || is_context_pending_deletion(handle)) {
                     log_warn("Context for stream %s is no longer valid, exiting thread", stream_name);
                     thread_state = HLS_THREAD_STOPPING;
                     break;
@@ -1539,7 +1296,7 @@ void *hls_unified_thread_func(void *arg) {
                 }
 
                 // CRITICAL FIX: Check if context is still valid before accessing
-                if (!ctx || is_context_pending_deletion(ctx) || is_context_already_freed(ctx)) {
+                if (!ctx || is_context_pending_deletion(handle) || is_context_already_freed(handle)) {
                     log_warn("Context for stream %s is no longer valid, skipping reconnection attempt", stream_name);
                     thread_state = HLS_THREAD_STOPPING;
                     break;
@@ -1574,7 +1331,7 @@ void *hls_unified_thread_func(void *arg) {
                     av_strerror(ret, error_buf, AV_ERROR_MAX_STRING_SIZE);
 
                     // Log the error but don't treat any error type specially
-                    log_error("Failed to reconnect to stream %s: %s (error code: %d)",
+                    log_error_ratelimited("Failed to reconnect to stream %s: %s (error code: %d)",
                              stream_name, error_buf, ret);
 
                     // MEMORY LEAK FIX: Use comprehensive cleanup instead of just avformat_close_input
@@ -1619,10 +1376,10 @@ void *hls_unified_thread_func(void *arg) {
                 // Find video stream
                 video_stream_idx = find_video_stream_index(input_ctx);
                 if (video_stream_idx == -1) {
-                    log_error("No video stream found in %s during reconnection", ctx->rtsp_url);
+                    log_error_ratelimited("No video stream found in %s during reconnection", ctx->rtsp_url);
 
                     // Close input context
-                    avformat_close_input(&input_ctx);
+                    safe_avformat_cleanup(&input_ctx);
 
                     // Increment reconnection attempt counter
                     reconnect_attempt++;
@@ -1681,12 +1438,38 @@ void *hls_unified_thread_func(void *arg) {
                 // Reconnection successful
                 log_info("Successfully reconnected to stream %s after %d attempts",
                         stream_name, reconnect_attempt);
+                metrics_add(reconnects_metric, 1);
                 thread_state = HLS_THREAD_RUNNING;
                 reconnect_attempt = 0;
                 atomic_store(&ctx->connection_valid, 1);
                 atomic_store(&ctx->consecutive_failures, 0);
                 last_packet_time = time(NULL);
-                atomic_store(&ctx->last_packet_time, (int_fast64_t)last_packet_time);
+                publish_heartbeat(ctx, last_packet_time);
+                break;
+
+            case HLS_THREAD_IDLE:
+                // Idle is healthy: keep the supervisor from restarting the thread
+                atomic_store(&ctx->connection_valid, 1);
+                last_packet_time = time(NULL);
+                publish_heartbeat(ctx, last_packet_time);
+
+                if (!hls_viewers_wait(stream_name, 1000)) {
+                    break;
+                }
+
+                log_info("HLS viewer for stream %s, resuming live HLS", stream_name);
+                ctx->writer = hls_writer_create(ctx->output_path, stream_name, 5, ctx->segment_format);
+                if (!ctx->writer) {
+                    log_error("Failed to create HLS writer for %s", stream_name);
+                    thread_state = HLS_THREAD_STOPPING;
+                    break;
+                }
+                if (state) {
+                    state->hls_ctx = ctx->writer;
+                }
+
+                thread_state = HLS_THREAD_CONNECTING;
+                reconnect_attempt = 0;
                 break;
 
             case HLS_THREAD_STOPPING:
@@ -1700,6 +1483,12 @@ void *hls_unified_thread_func(void *arg) {
                 // Clean up input context and packet
                 safe_cleanup_resources(&input_ctx, &pkt, NULL);
 
+                // Detach from the shared ingest before the writer goes away
+                if (ingest_consumer) {
+                    stream_ingest_detach(ingest_consumer);
+                    ingest_consumer = NULL;
+                }
+
                 // Clean up HLS writer if it exists
                 if (ctx->writer) {
                     log_info("Closing HLS writer for stream %s during shutdown", stream_name);
@@ -1734,6 +1523,19 @@ void *hls_unified_thread_func(void *arg) {
         }
     }
 
+    // The loop can exit without passing through STOPPING
+    if (ingest_consumer) {
+        stream_ingest_detach(ingest_consumer);
+        ingest_consumer = NULL;
+    }
+
+    if (on_demand) {
+        hls_viewers_unregister(stream_name);
+    }
+
+    // Renditions are transcoded from this stream's ingest
+    hls_abr_stop(stream_name);
+
     // Signal that the thread is exiting
     // Make a local copy of the context pointer to prevent race conditions
     hls_unified_thread_ctx_t *ctx_for_exit = ctx;
@@ -1741,7 +1543,7 @@ void *hls_unified_thread_func(void *arg) {
 
     // CRITICAL FIX: Check if the context is already freed or pending deletion
     // This prevents accessing invalid memory during cleanup
-    bool context_valid_for_exit = ctx_for_exit && !is_context_already_freed(ctx_for_exit) && !is_context_pending_deletion(ctx_for_exit);
+    bool context_valid_for_exit = ctx_for_exit && !is_context_already_freed(handle) && !is_context_pending_deletion(handle);
 
     // Store stream name in local buffer for logging even if context becomes invalid
     char stream_name_buf[MAX_STREAM_NAME] = {0};
@@ -1794,8 +1596,8 @@ void *hls_unified_thread_func(void *arg) {
         }
 
         // Mark thread as exited in the pending deletion list
-        // This is safe to do even if the context is freed, as mark_thread_exited handles NULL contexts
-        mark_thread_exited(ctx_for_exit);
+        // This is safe to do even if the context is freed, as mark_thread_exited only uses the handle
+        mark_thread_exited(handle);
 
         // Only access ctx members if the context is not already freed
         if (context_valid_for_exit) {
@@ -1811,7 +1613,7 @@ void *hls_unified_thread_func(void *arg) {
 
             // CRITICAL FIX: Check if context is still valid before accessing its members
             // This prevents use-after-free errors when the context has been freed
-            if (!is_context_already_freed(ctx_for_exit) && !is_context_pending_deletion(ctx_for_exit)) {
+            if (!is_context_already_freed(handle) && !is_context_pending_deletion(handle)) {
                 // Mark connection as invalid
                 atomic_store(&ctx_for_exit->connection_valid, 0);
 
@@ -1838,7 +1640,7 @@ void *hls_unified_thread_func(void *arg) {
         hls_writer_t *writer_ptr = NULL;
 
         // Only access ctx members if the context is not already freed
-        if (ctx && !is_context_already_freed(ctx)) {
+        if (ctx && !is_context_already_freed(handle)) {
             writer_ptr = ctx->writer;
         }
 
@@ -1876,7 +1678,7 @@ void *hls_unified_thread_func(void *arg) {
     ctx = NULL;  // Clear the original pointer to prevent further access
 
     // Check if the context is valid before accessing its members
-    if (ctx_local && !is_context_already_freed(ctx_local) && !is_context_pending_deletion(ctx_local)) {
+    if (ctx_local && !is_context_already_freed(handle) && !is_context_pending_deletion(handle)) {
         // Safely get the writer pointer
         hls_writer_t *writer_ptr = NULL;
 
@@ -1961,7 +1763,7 @@ void *hls_unified_thread_func(void *arg) {
     // CRITICAL FIX: Ensure the thread is marked as exited in the pending deletion list
     // This is a final safety check to prevent memory leaks and deadlocks
     if (ctx_local) {
-        mark_thread_exited(ctx_local);
+        mark_thread_exited(handle);
         log_info("Final marking of thread as exited for stream %s", stream_name_buf);
     }
 
@@ -2010,7 +1812,7 @@ void *hls_unified_thread_func(void *arg) {
 
         if (context_valid) {
             // CRITICAL FIX: Check if the context has already been freed
-            if (is_context_already_freed(ctx_to_free)) {
+            if (is_context_already_freed(handle)) {
                 log_warn("Context for stream %s has already been freed, skipping", stream_name_buf);
             } else {
                 // Free the context
@@ -2027,19 +1829,16 @@ void *hls_unified_thread_func(void *arg) {
                 alarm(15); // 15 second timeout for context free
 
                 // Mark the context as pending deletion to signal the thread
-                mark_context_pending_deletion(ctx_to_free);
+                mark_context_pending_deletion(handle);
 
                 // Wait for the thread to exit
-                wait_for_thread_exit(ctx_to_free);
-
-                // Mark the context as freed before actually freeing it
-                mark_context_as_freed(ctx_to_free);
+                wait_for_thread_exit(handle);
 
-                // Clear from pending deletion list
-                clear_context_pending_deletion(ctx_to_free);
+                // Release the handle before actually freeing the context
+                release_context_handle(handle);
 
                 // Free the context with additional protection
-                safe_free(ctx_to_free);
+                stream_arena_free(ctx_to_free);
 
                 // Cancel the alarm and restore signal handler
                 alarm(0);
@@ -2123,9 +1922,9 @@ void *hls_unified_thread_func(void *arg) {
 
     // CRITICAL FIX: Add final safety check before marking thread as exited
     // This prevents segmentation faults if the context has been freed during cleanup
-    if (ctx_for_exit && !is_context_already_freed(ctx_for_exit)) {
+    if (ctx_for_exit && !is_context_already_freed(handle)) {
         // Mark thread as exited to ensure proper cleanup
-        mark_thread_exited(ctx_for_exit);
+        mark_thread_exited(handle);
     } else {
         log_info("Context for stream %s is no longer valid, skipping final thread exit marking", stream_name_buf);
     }
@@ -2138,12 +1937,34 @@ void *hls_unified_thread_func(void *arg) {
 pthread_mutex_t unified_contexts_mutex = PTHREAD_MUTEX_INITIALIZER;
 hls_unified_thread_ctx_t *unified_contexts[MAX_STREAMS];
 
-// Watchdog thread variables
-static pthread_t hls_watchdog_thread;
-static atomic_bool watchdog_running = ATOMIC_VAR_INIT(false);
+// Restarts of stalled HLS threads by the stream supervisor
 static atomic_int watchdog_restart_count = ATOMIC_VAR_INIT(0);
-static time_t last_restart_time[MAX_STREAMS] = {0};
-static int restart_attempts[MAX_STREAMS] = {0};
+
+/**
+ * Restart the HLS thread of a stream that stopped beating, for the stream supervisor
+ */
+static int restart_stalled_hls_stream(const char *stream_name) {
+    if (is_shutdown_initiated()) {
+        return 0;
+    }
+
+    // A stream deleted or disabled without stopping its HLS thread is not brought back
+    stream_handle_t stream = get_stream_by_name(stream_name);
+    stream_config_t config;
+    if (!stream || get_stream_config(stream, &config) != 0 || !config.enabled) {
+        return -1;
+    }
+
+    stop_hls_unified_stream(stream_name);
+    if (start_hls_unified_stream(stream_name) != 0) {
+        log_error("Failed to restart HLS thread for stream %s", stream_name);
+        return 0;
+    }
+
+    atomic_fetch_add(&watchdog_restart_count, 1);
+    log_info("Restarted HLS thread for stream %s", stream_name);
+    return 0;
+}
 
 /**
  * Start HLS streaming for a stream using the unified thread approach
@@ -2271,15 +2092,14 @@ int start_hls_unified_stream(const char *stream_name) {
     log_info("Clearing any existing HLS segments for stream %s before starting", stream_name);
     clear_stream_hls_segments(stream_name);
 
-    // Create context with memory guards
-    hls_unified_thread_ctx_t *ctx = safe_malloc(sizeof(hls_unified_thread_ctx_t));
+    // Allocated from the stream's arena, which reuses the block when the stream restarts
+    hls_unified_thread_ctx_t *ctx = stream_arena_alloc(stream_name, sizeof(hls_unified_thread_ctx_t));
     if (!ctx) {
         log_error("Memory allocation failed for unified HLS context");
+        pthread_mutex_unlock(&unified_contexts_mutex);
         return -1;
     }
 
-    // Initialize the memory to zero
-    memset(ctx, 0, sizeof(hls_unified_thread_ctx_t));
     strncpy(ctx->stream_name, stream_name, MAX_STREAM_NAME - 1);
     ctx->stream_name[MAX_STREAM_NAME - 1] = '\0';
 
@@ -2324,6 +2144,10 @@ int start_hls_unified_stream(const char *stream_name) {
 
     // Set segment duration
     ctx->segment_duration = config.segment_duration > 0 ? config.segment_duration : 2;
+    ctx->segment_format = config.hls_segment_format;
+    ctx->record_segments = hls_recording_applies(&config);
+    ctx->recording_duration = config.segment_duration;
+    ctx->on_demand = hls_viewers_applies(&config);
 
     // Create output paths
     config_t *global_config = get_streaming_config();
@@ -2364,14 +2188,16 @@ int start_hls_unified_stream(const char *stream_name) {
         // Create the final directory
         if (mkdir(temp_path, 0777) != 0 && errno != EEXIST) {
             log_error("Failed to create output directory: %s (error: %s)", temp_path, strerror(errno));
-            safe_free(ctx);
+            stream_arena_free(ctx);
+            pthread_mutex_unlock(&unified_contexts_mutex);
             return -1;
         }
 
         // Verify the directory was created
         if (stat(ctx->output_path, &st) != 0 || !S_ISDIR(st.st_mode)) {
             log_error("Failed to verify output directory: %s", ctx->output_path);
-            safe_free(ctx);
+            stream_arena_free(ctx);
+            pthread_mutex_unlock(&unified_contexts_mutex);
             return -1;
         }
     }
@@ -2405,7 +2231,8 @@ int start_hls_unified_stream(const char *stream_name) {
     FILE *test = fopen(test_file, "w");
     if (!test) {
         log_error("Directory is not writable: %s (error: %s)", ctx->output_path, strerror(errno));
-        free(ctx);
+        stream_arena_free(ctx);
+        pthread_mutex_unlock(&unified_contexts_mutex);
         return -1;
     }
     fclose(test);
@@ -2419,20 +2246,29 @@ int start_hls_unified_stream(const char *stream_name) {
     atomic_store(&ctx->last_packet_time, (int_fast64_t)time(NULL));
     atomic_store(&ctx->thread_state, HLS_THREAD_INITIALIZING);
 
-    // Set up thread attributes to create a detached thread
-    pthread_attr_t attr;
-    pthread_attr_init(&attr);
-    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    // Register the context before the thread can check its handle
+    ctx->handle = handle_table_insert(&context_handles, ctx);
+    if (ctx->handle == HANDLE_INVALID) {
+        log_error("No free context handle for unified HLS thread %s", stream_name);
+        stream_arena_free(ctx);
+        pthread_mutex_unlock(&unified_contexts_mutex);
+        return -1;
+    }
 
-    // Start thread with detached state
-    int thread_result = pthread_create(&ctx->thread, &attr, hls_unified_thread_func, ctx);
+    // Supervised from here until a deliberate stop
+    ctx->heartbeat = supervisor_register(stream_name, "hls", HLS_HEARTBEAT_TIMEOUT_MS,
+                                         restart_stalled_hls_stream);
 
-    // Clean up thread attributes
-    pthread_attr_destroy(&attr);
+    // Start thread with detached state and a bounded stack
+    int thread_result = pthread_create_with_stack(&ctx->thread, hls_unified_thread_func, ctx,
+                                                  STREAM_THREAD_STACK_SIZE, true);
 
     if (thread_result != 0) {
         log_error("Failed to create unified HLS thread for %s", stream_name);
-        safe_free(ctx);
+        supervisor_unregister(ctx->heartbeat);
+        release_context_handle(ctx->handle);
+        stream_arena_free(ctx);
+        pthread_mutex_unlock(&unified_contexts_mutex);
         return -1;
     }
 
@@ -2544,6 +2380,7 @@ int stop_hls_unified_stream(const char *stream_name) {
     pthread_mutex_lock(&unified_contexts_mutex);
 
     hls_unified_thread_ctx_t *ctx = NULL;
+    handle_t handle = HANDLE_INVALID;
     int index = -1;
     int contexts_found = 0;
     int indices[MAX_STREAMS];
@@ -2555,6 +2392,7 @@ int stop_hls_unified_stream(const char *stream_name) {
             if (contexts_found == 0) {
                 // Store the first one we find as the primary context to stop
                 ctx = unified_contexts[i];
+                handle = ctx->handle;
                 index = i;
             }
             indices[contexts_found] = i;
@@ -2596,6 +2434,7 @@ int stop_hls_unified_stream(const char *stream_name) {
 
     // Now mark as not running using atomic store for thread safety
     atomic_store(&ctx->running, 0);
+    supervisor_unregister(ctx->heartbeat);
     log_info("Marked HLS stream %s as stopping (index: %d)", stream_name, index);
 
     // Reset the timestamp tracker for this stream to ensure clean state when restarted
@@ -2634,13 +2473,13 @@ int stop_hls_unified_stream(const char *stream_name) {
     if (index >= 0 && index < MAX_STREAMS && unified_contexts[index] == ctx) {
         // CRITICAL FIX: First mark the context as pending deletion before accessing its members
         // This ensures that the thread will know not to access the context anymore
-        mark_context_pending_deletion(ctx);
+        mark_context_pending_deletion(handle);
 
         // CRITICAL FIX: Add a memory barrier to ensure the pending deletion flag is visible to all threads
         __sync_synchronize();
 
         // CRITICAL FIX: Clear the writer reference in the context before freeing to prevent double free
-        if (ctx && !is_context_already_freed(ctx)) {
+        if (ctx && !is_context_already_freed(handle)) {
             // Use a try/catch-like approach with signal handling to prevent crashes
             struct sigaction sa_old, sa_new;
             sigaction(SIGSEGV, NULL, &sa_old);
@@ -2682,7 +2521,7 @@ int stop_hls_unified_stream(const char *stream_name) {
         // CRITICAL FIX: Add additional safety checks before freeing the context
         if (ctx) {
             // Check if the context is already marked as freed
-            if (is_context_already_freed(ctx)) {
+            if (is_context_already_freed(handle)) {
                 log_warn("Context for stream %s has already been freed, skipping", stream_name);
                 return 0;
             }
@@ -2726,7 +2565,7 @@ int stop_hls_unified_stream(const char *stream_name) {
 
             if (context_valid) {
                 // CRITICAL FIX: Check if the context has already been freed
-                if (is_context_already_freed(ctx_to_free)) {
+                if (is_context_already_freed(handle)) {
                     log_warn("Context for stream %s has already been freed, skipping", stream_name);
                 } else {
                     // Free the context
@@ -2743,7 +2582,7 @@ int stop_hls_unified_stream(const char *stream_name) {
                     alarm(15); // 15 second timeout for context free
 
                     // CRITICAL FIX: Mark the context as pending deletion to signal the thread
-                    mark_context_pending_deletion(ctx_to_free);
+                    mark_context_pending_deletion(handle);
 
                     // Add a memory barrier to ensure the pending deletion flag is visible to all threads
                     __sync_synchronize();
@@ -2753,16 +2592,13 @@ int stop_hls_unified_stream(const char *stream_name) {
 
                     // Wait for the thread to exit with increased timeout
                     log_info("Waiting for thread to exit for context %p (stream %s)", ctx_to_free, stream_name);
-                    wait_for_thread_exit(ctx_to_free);
-
-                    // Mark the context as freed before actually freeing it
-                    mark_context_as_freed(ctx_to_free);
+                    wait_for_thread_exit(handle);
 
-                    // Clear from pending deletion list
-                    clear_context_pending_deletion(ctx_to_free);
+                    // Release the handle before actually freeing the context
+                    release_context_handle(handle);
 
                     // Free the context with additional protection
-                    safe_free(ctx_to_free);
+                    stream_arena_free(ctx_to_free);
 
                     // Cancel the alarm and restore signal handler
                     alarm(0);
@@ -2797,11 +2633,11 @@ int stop_hls_unified_stream(const char *stream_name) {
             hls_unified_thread_ctx_t *extra_ctx = unified_contexts[i];
             unified_contexts[i] = NULL;
 
-            // Mark the context as freed before actually freeing it
-            mark_context_as_freed(extra_ctx);
+            // Release the handle before actually freeing the context
+            release_context_handle(extra_ctx->handle);
 
             // Free the context
-            safe_free(extra_ctx);
+            stream_arena_free(extra_ctx);
 
             log_info("Cleaned up additional HLS context for stream %s", stream_name);
         }
@@ -2855,6 +2691,35 @@ int is_hls_stream_active(const char *stream_name) {
     return 0;
 }
 
+/**
+ * Get the input of a running HLS thread, to attach to the same shared ingest
+ */
+int get_hls_stream_input(const char *stream_name, char *url, size_t url_size, int *protocol) {
+    if (!stream_name || !url || url_size == 0) {
+        return -1;
+    }
+
+    int ret = -1;
+    pthread_mutex_lock(&unified_contexts_mutex);
+
+    for (int i = 0; i < MAX_STREAMS; i++) {
+        if (unified_contexts[i] &&
+            strcmp(unified_contexts[i]->stream_name, stream_name) == 0 &&
+            atomic_load(&unified_contexts[i]->running)) {
+            strncpy(url, unified_contexts[i]->rtsp_url, url_size - 1);
+            url[url_size - 1] = '\0';
+            if (protocol) {
+                *protocol = unified_contexts[i]->protocol;
+            }
+            ret = 0;
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&unified_contexts_mutex);
+    return ret;
+}
+
 /**
  * FFmpeg buffer cleanup function
  * This function forces FFmpeg to release any cached memory
@@ -2983,19 +2848,8 @@ static void ffmpeg_buffer_cleanup(void) {
  * Initialize the freed contexts tracking system
  */
 static void init_freed_contexts_tracking(void) {
-    log_info("Initializing freed contexts tracking system");
-
-    // Initialize the freed contexts array
-    pthread_mutex_lock(&freed_contexts_mutex);
-    memset(freed_contexts, 0, sizeof(freed_contexts));
-    freed_contexts_count = 0;
-    pthread_mutex_unlock(&freed_contexts_mutex);
-
-    // Initialize the pending deletions array
-    pthread_mutex_lock(&pending_deletions_mutex);
-    memset(pending_deletions, 0, sizeof(pending_deletions));
-    pthread_mutex_unlock(&pending_deletions_mutex);
-
+    // The handle table is statically zero-initialized; handles of contexts from
+    // a previous start are still released by whoever frees those contexts
     log_info("Freed contexts tracking system initialized");
 }
 
@@ -3003,22 +2857,13 @@ static void init_freed_contexts_tracking(void) {
  * Cleanup the freed contexts tracking system
  */
 static void cleanup_freed_contexts_tracking(void) {
-    // First, wait for any pending deletions to complete
-    pthread_mutex_lock(&pending_deletions_mutex);
-
-    // Check if there are any pending deletions
+    // Wait for any pending deletions to complete
     bool has_pending = false;
-    for (int i = 0; i < MAX_STREAMS; i++) {
-        if (pending_deletions[i].ctx != NULL && atomic_load(&pending_deletions[i].pending_deletion)) {
+    for (int i = 0; i < HANDLE_TABLE_SLOTS; i++) {
+        handle_t handle = handle_table_handle_at(&context_handles, i);
+        if (handle != HANDLE_INVALID && is_context_pending_deletion(handle) && !has_thread_exited(handle)) {
             has_pending = true;
-            log_info("Waiting for thread to exit for context %p", pending_deletions[i].ctx);
-
-            // Wait for the thread to exit
-            if (!atomic_load(&pending_deletions[i].thread_exited)) {
-                pthread_mutex_unlock(&pending_deletions_mutex);
-                wait_for_thread_exit(pending_deletions[i].ctx);
-                pthread_mutex_lock(&pending_deletions_mutex);
-            }
+            wait_for_thread_exit(handle);
         }
     }
 
@@ -3026,16 +2871,6 @@ static void cleanup_freed_contexts_tracking(void) {
         log_info("All pending deletions have been processed");
     }
 
-    // Clear the pending deletions array
-    memset(pending_deletions, 0, sizeof(pending_deletions));
-    pthread_mutex_unlock(&pending_deletions_mutex);
-
-    // Clear the freed contexts array
-    pthread_mutex_lock(&freed_contexts_mutex);
-    memset(freed_contexts, 0, sizeof(freed_contexts));
-    freed_contexts_count = 0;
-    pthread_mutex_unlock(&freed_contexts_mutex);
-
     log_info("Cleaned up freed contexts tracking system");
 }
 
@@ -3055,9 +2890,6 @@ void cleanup_hls_unified_thread_system(void) {
 
     log_info("Cleaning up HLS unified thread system...");
 
-    // Stop the watchdog thread
-    stop_hls_watchdog();
-
     // CRITICAL FIX: Use try/catch-like approach with signal handling to prevent crashes
     struct sigaction sa_old, sa_new;
     sigaction(SIGSEGV, NULL, &sa_old);
@@ -3121,206 +2953,7 @@ static void init_ffmpeg_memory_cleanup(void) {
 }
 
 /**
- * Check if a thread is still running
- * This function checks if a thread is still running by examining its state
- *
- * @param ctx The thread context
- * @return true if running, false if not
- */
-static bool is_thread_running(hls_unified_thread_ctx_t *ctx) {
-    if (!ctx) {
-        return false;
-    }
-
-    // Check if the thread is marked as running
-    if (!atomic_load(&ctx->running)) {
-        return false;
-    }
-
-    // Check if the thread state is STOPPED
-    if (atomic_load(&ctx->thread_state) == HLS_THREAD_STOPPED) {
-        return false;
-    }
-
-    // Check if we've received a packet recently
-    time_t last_packet = (time_t)atomic_load(&ctx->last_packet_time);
-    time_t now = time(NULL);
-    if (now - last_packet > MAX_PACKET_TIMEOUT * 3) { // 3x the normal timeout for watchdog
-        log_warn("Thread for stream %s has not received a packet in %ld seconds",
-                ctx->stream_name, now - last_packet);
-        return false;
-    }
-
-    return true;
-}
-
-/**
- * Watchdog thread function
- * This function periodically checks all HLS threads and restarts any that have exited unexpectedly
- *
- * @param arg Not used
- * @return NULL
- */
-static void *hls_watchdog_thread_func(void *arg) {
-    log_info("HLS watchdog thread started");
-
-    while (atomic_load(&watchdog_running)) {
-        // Sleep for the check interval
-        sleep(WATCHDOG_CHECK_INTERVAL_SEC);
-
-        // Check if we should continue running
-        if (!atomic_load(&watchdog_running) || is_shutdown_initiated()) {
-            log_info("HLS watchdog thread stopping");
-            break;
-        }
-
-        log_debug("HLS watchdog checking thread status...");
-
-        // Lock the contexts mutex
-        pthread_mutex_lock(&unified_contexts_mutex);
-
-        // Check each context
-        for (int i = 0; i < MAX_STREAMS; i++) {
-            hls_unified_thread_ctx_t *ctx = unified_contexts[i];
-            if (!ctx) {
-                continue;
-            }
-
-            // Skip contexts that are already marked for deletion
-            if (is_context_pending_deletion(ctx)) {
-                continue;
-            }
-
-            // Check if the thread is still running
-            if (!is_thread_running(ctx)) {
-                log_warn("HLS thread for stream %s has exited unexpectedly", ctx->stream_name);
-
-                // Check if we should restart the thread
-                time_t now = time(NULL);
-                if (now - last_restart_time[i] < WATCHDOG_RESTART_COOLDOWN_SEC) {
-                    log_warn("Cooldown period not elapsed for stream %s, not restarting yet",
-                            ctx->stream_name);
-                    continue;
-                }
-
-                // Check if we've exceeded the maximum restart attempts
-                if (restart_attempts[i] >= WATCHDOG_MAX_RESTART_ATTEMPTS) {
-                    log_error("Maximum restart attempts (%d) exceeded for stream %s, not restarting",
-                             WATCHDOG_MAX_RESTART_ATTEMPTS, ctx->stream_name);
-                    continue;
-                }
-
-                // Store the stream name before unlocking the mutex
-                char stream_name[MAX_STREAM_NAME];
-                strncpy(stream_name, ctx->stream_name, MAX_STREAM_NAME - 1);
-                stream_name[MAX_STREAM_NAME - 1] = '\0';
-
-                // Unlock the mutex before restarting the stream
-                pthread_mutex_unlock(&unified_contexts_mutex);
-
-                log_info("Attempting to restart HLS thread for stream %s (attempt %d)",
-                        stream_name, restart_attempts[i] + 1);
-
-                // Stop the stream first to clean up any resources
-                stop_hls_unified_stream(stream_name);
-
-                // Wait a bit to ensure the stream is fully stopped
-                usleep(1000000); // 1 second
-
-                // Start the stream again
-                int result = start_hls_unified_stream(stream_name);
-                if (result == 0) {
-                    log_info("Successfully restarted HLS thread for stream %s", stream_name);
-
-                    // Update restart statistics
-                    pthread_mutex_lock(&unified_contexts_mutex);
-                    last_restart_time[i] = time(NULL);
-                    restart_attempts[i]++;
-                    atomic_fetch_add(&watchdog_restart_count, 1);
-                    pthread_mutex_unlock(&unified_contexts_mutex);
-                } else {
-                    log_error("Failed to restart HLS thread for stream %s", stream_name);
-
-                    // Update restart statistics
-                    pthread_mutex_lock(&unified_contexts_mutex);
-                    last_restart_time[i] = time(NULL);
-                    restart_attempts[i]++;
-                    pthread_mutex_unlock(&unified_contexts_mutex);
-                }
-
-                // Re-lock the mutex to continue the loop
-                pthread_mutex_lock(&unified_contexts_mutex);
-            } else {
-                // Thread is running, reset restart attempts if it's been running for a while
-                time_t now = time(NULL);
-                if (restart_attempts[i] > 0 && now - last_restart_time[i] > WATCHDOG_RESTART_COOLDOWN_SEC * 2) {
-                    log_info("Resetting restart attempts for stream %s after stable period", ctx->stream_name);
-                    restart_attempts[i] = 0;
-                }
-            }
-        }
-
-        // Unlock the mutex
-        pthread_mutex_unlock(&unified_contexts_mutex);
-    }
-
-    log_info("HLS watchdog thread exited");
-    return NULL;
-}
-
-/**
- * Start the HLS watchdog thread
- */
-static void start_hls_watchdog(void) {
-    // Check if the watchdog is already running
-    if (atomic_load(&watchdog_running)) {
-        log_warn("HLS watchdog thread is already running");
-        return;
-    }
-
-    // Initialize restart tracking arrays
-    memset(last_restart_time, 0, sizeof(last_restart_time));
-    memset(restart_attempts, 0, sizeof(restart_attempts));
-
-    // Set the watchdog running flag
-    atomic_store(&watchdog_running, true);
-    atomic_store(&watchdog_restart_count, 0);
-
-    // Create the watchdog thread
-    pthread_attr_t attr;
-    pthread_attr_init(&attr);
-    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
-
-    int result = pthread_create(&hls_watchdog_thread, &attr, hls_watchdog_thread_func, NULL);
-    pthread_attr_destroy(&attr);
-
-    if (result != 0) {
-        log_error("Failed to create HLS watchdog thread");
-        atomic_store(&watchdog_running, false);
-    } else {
-        log_info("Started HLS watchdog thread");
-    }
-}
-
-/**
- * Stop the HLS watchdog thread
- */
-static void stop_hls_watchdog(void) {
-    // Check if the watchdog is running
-    if (!atomic_load(&watchdog_running)) {
-        log_warn("HLS watchdog thread is not running");
-        return;
-    }
-
-    // Set the watchdog running flag to false
-    atomic_store(&watchdog_running, false);
-
-    // The thread is detached, so we don't need to join it
-    log_info("Signaled HLS watchdog thread to stop");
-}
-
-/**
- * Get the number of HLS thread restarts performed by the watchdog
+ * Get the number of HLS thread restarts performed by the stream supervisor
  */
 int get_hls_watchdog_restart_count(void) {
     return atomic_load(&watchdog_restart_count);
@@ -3338,8 +2971,5 @@ void init_hls_unified_thread_system(void) {
     // Initialize the FFmpeg memory cleanup system
     init_ffmpeg_memory_cleanup();
 
-    // Start the HLS watchdog thread
-    start_hls_watchdog();
-
-    log_info("HLS unified thread system initialized with watchdog monitoring");
+    log_info("HLS unified thread system initialized");
 }
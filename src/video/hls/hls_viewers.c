@@ -0,0 +1,207 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "core/logger.h"
+#include "video/stream_registry.h"
+#include "video/stream_ingest.h"
+#include "video/hls_recording.h"
+#include "video/hls/hls_viewers.h"
+
+/**
+ * Viewers of one stream
+ * Slots are indexed by stream registry ID; a registered slot holds a
+ * reference on its ID. Slots are allocated on first use and reused afterwards.
+ */
+typedef struct {
+    bool registered;
+    char stream_name[MAX_STREAM_NAME];
+    struct timespec last_request;   // CLOCK_MONOTONIC, zero before the first request
+    pthread_cond_t cond;            // Signaled on every request
+} viewer_slot_t;
+
+static viewer_slot_t *slots[MAX_STREAMS];
+static pthread_mutex_t viewers_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Find the registered slot of a stream
+ * Must be called with viewers_mutex held.
+ */
+static viewer_slot_t *find_slot(const char *stream_name) {
+    if (!stream_name || stream_name[0] == '\0') {
+        return NULL;
+    }
+
+    int id = stream_registry_lookup(stream_name);
+    if (id < 0 || id >= MAX_STREAMS) {
+        return NULL;
+    }
+
+    viewer_slot_t *slot = slots[id];
+    if (!slot || !slot->registered || strcmp(slot->stream_name, stream_name) != 0) {
+        return NULL;
+    }
+    return slot;
+}
+
+/**
+ * Get the seconds since the last request of a slot, or -1 if none came
+ * Must be called with viewers_mutex held.
+ */
+static double seconds_since_request(const viewer_slot_t *slot) {
+    if (slot->last_request.tv_sec == 0 && slot->last_request.tv_nsec == 0) {
+        return -1.0;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - slot->last_request.tv_sec) +
+           (double)(now.tv_nsec - slot->last_request.tv_nsec) / 1e9;
+}
+
+bool hls_viewers_applies(const stream_config_t *config) {
+    return config && g_config.hls_on_demand && stream_ingest_enabled() &&
+           !hls_recording_applies(config);
+}
+
+int hls_viewers_register(const char *stream_name) {
+    if (!stream_name || stream_name[0] == '\0') {
+        return -1;
+    }
+
+    int id = stream_registry_acquire(stream_name);
+    if (id == STREAM_ID_INVALID || id >= MAX_STREAMS) {
+        stream_registry_release(id);
+        log_error("Failed to register HLS viewers for stream %s", stream_name);
+        return -1;
+    }
+
+    pthread_mutex_lock(&viewers_mutex);
+
+    viewer_slot_t *slot = slots[id];
+    if (!slot) {
+        slot = calloc(1, sizeof(viewer_slot_t));
+        if (!slot) {
+            pthread_mutex_unlock(&viewers_mutex);
+            stream_registry_release(id);
+            log_error("Failed to allocate HLS viewers for stream %s", stream_name);
+            return -1;
+        }
+        pthread_cond_init(&slot->cond, NULL);
+        slots[id] = slot;
+    }
+
+    // A thread that never unregistered already holds the ID
+    bool replaced = slot->registered;
+
+    slot->registered = true;
+    strncpy(slot->stream_name, stream_name, MAX_STREAM_NAME - 1);
+    slot->stream_name[MAX_STREAM_NAME - 1] = '\0';
+    // The thread starts writing, so it counts as watched until the first timeout
+    clock_gettime(CLOCK_MONOTONIC, &slot->last_request);
+
+    pthread_mutex_unlock(&viewers_mutex);
+
+    if (replaced) {
+        stream_registry_release(id);
+    }
+
+    log_info("Live HLS for stream %s is written on demand", stream_name);
+    return 0;
+}
+
+void hls_viewers_unregister(const char *stream_name) {
+    pthread_mutex_lock(&viewers_mutex);
+
+    viewer_slot_t *slot = find_slot(stream_name);
+    if (!slot) {
+        pthread_mutex_unlock(&viewers_mutex);
+        return;
+    }
+
+    int id = stream_registry_lookup(stream_name);
+    slot->registered = false;
+    pthread_cond_broadcast(&slot->cond);
+
+    pthread_mutex_unlock(&viewers_mutex);
+
+    stream_registry_release(id);
+}
+
+void hls_viewers_touch(const char *stream_name) {
+    pthread_mutex_lock(&viewers_mutex);
+
+    viewer_slot_t *slot = find_slot(stream_name);
+    if (slot) {
+        clock_gettime(CLOCK_MONOTONIC, &slot->last_request);
+        pthread_cond_broadcast(&slot->cond);
+    }
+
+    pthread_mutex_unlock(&viewers_mutex);
+}
+
+bool hls_viewers_on_demand(const char *stream_name) {
+    pthread_mutex_lock(&viewers_mutex);
+    bool on_demand = find_slot(stream_name) != NULL;
+    pthread_mutex_unlock(&viewers_mutex);
+    return on_demand;
+}
+
+bool hls_viewers_active(const char *stream_name, int idle_seconds) {
+    pthread_mutex_lock(&viewers_mutex);
+
+    // Streams that are not on demand are always written
+    bool active = true;
+    viewer_slot_t *slot = find_slot(stream_name);
+    if (slot) {
+        double since = seconds_since_request(slot);
+        active = since >= 0.0 && since < (double)idle_seconds;
+    }
+
+    pthread_mutex_unlock(&viewers_mutex);
+    return active;
+}
+
+bool hls_viewers_wait(const char *stream_name, int timeout_ms) {
+    pthread_mutex_lock(&viewers_mutex);
+
+    viewer_slot_t *slot = find_slot(stream_name);
+    if (!slot) {
+        pthread_mutex_unlock(&viewers_mutex);
+        return false;
+    }
+
+    double since = seconds_since_request(slot);
+    if (since >= 0.0 && since < 1.0) {
+        pthread_mutex_unlock(&viewers_mutex);
+        return true;
+    }
+
+    struct timespec before = slot->last_request;
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    bool touched = false;
+    while (slot->registered) {
+        if (slot->last_request.tv_sec != before.tv_sec ||
+            slot->last_request.tv_nsec != before.tv_nsec) {
+            touched = true;
+            break;
+        }
+        if (pthread_cond_timedwait(&slot->cond, &viewers_mutex, &deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&viewers_mutex);
+    return touched;
+}
@@ -0,0 +1,555 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <libavcodec/avcodec.h>
+
+#include "video/hls_recording.h"
+#include "video/recording_thumbnails.h"
+#include "core/config.h"
+#include "core/logger.h"
+#include "database/db_recordings.h"
+#include "storage/recording_layout.h"
+
+// Recording length when the stream has no segment_duration, as for MP4 recordings
+#define HLS_RECORDING_DEFAULT_DURATION 30
+
+// Declared in the playlist; FFmpeg does not hold segments to it, and
+// playlists served to players are generated with the real longest segment
+#define HLS_RECORDING_TARGET_DURATION 10
+
+#define HLS_RECORDING_DIR_PREFIX "recording_"
+
+#define COPY_CHUNK (64 * 1024)
+
+struct hls_recording {
+    char stream_name[MAX_STREAM_NAME];
+    int max_duration;
+    bool copy_warned;
+
+    // Current recording, id 0 until the next segment starts one
+    uint64_t id;
+    char dir[MAX_PATH_LENGTH];
+    time_t start_time;
+    int sequence;               // Segments added
+    int64_t duration_ms;
+    uint64_t size_bytes;
+    time_t last_segment_time;   // When the last segment was added
+};
+
+/**
+ * Split a recording's file path into its directory, checking it is one of ours
+ */
+static bool recording_dir(const char *file_path, char *dir, size_t size) {
+    const char *slash = file_path ? strrchr(file_path, '/') : NULL;
+    if (!slash || strcmp(slash + 1, HLS_RECORDING_PLAYLIST_NAME) != 0) {
+        return false;
+    }
+
+    size_t len = (size_t)(slash - file_path);
+    const char *name = file_path;
+    for (const char *p = file_path; p < slash; p++) {
+        if (*p == '/') {
+            name = p + 1;
+        }
+    }
+    if (strncmp(name, HLS_RECORDING_DIR_PREFIX, strlen(HLS_RECORDING_DIR_PREFIX)) != 0 || len >= size) {
+        return false;
+    }
+
+    memcpy(dir, file_path, len);
+    dir[len] = '\0';
+    return true;
+}
+
+bool hls_recording_applies(const stream_config_t *config) {
+    return config && g_config.hls_recording && !g_config.hls_memory_store &&
+           config->record && config->streaming_enabled && config->hls_segment_format == HLS_SEGMENT_FMP4;
+}
+
+bool hls_recording_is_segmented(const char *file_path) {
+    char dir[MAX_PATH_LENGTH];
+    return recording_dir(file_path, dir, sizeof(dir));
+}
+
+/**
+ * Create a directory and the directories leading to it
+ */
+static int make_dirs(const char *path) {
+    char dir[MAX_PATH_LENGTH];
+    snprintf(dir, sizeof(dir), "%s", path);
+
+    for (char *p = dir + 1; ; p++) {
+        if (*p != '/' && *p != '\0') {
+            continue;
+        }
+        char c = *p;
+        *p = '\0';
+        if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+            return -1;
+        }
+        if (c == '\0') {
+            return 0;
+        }
+        *p = c;
+    }
+}
+
+/**
+ * Copy a file, for segments on another file system than the recordings
+ */
+static int copy_file(const char *src, const char *dst) {
+    int in = open(src, O_RDONLY | O_CLOEXEC);
+    if (in < 0) {
+        return -1;
+    }
+    int out = open(dst, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (out < 0) {
+        close(in);
+        return -1;
+    }
+
+    char *buffer = malloc(COPY_CHUNK);
+    int result = buffer ? 0 : -1;
+    while (result == 0) {
+        ssize_t n = read(in, buffer, COPY_CHUNK);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            result = n < 0 ? -1 : 0;
+            break;
+        }
+        for (ssize_t done = 0; done < n; ) {
+            ssize_t w = write(out, buffer + done, (size_t)(n - done));
+            if (w < 0 && errno == EINTR) {
+                continue;
+            }
+            if (w <= 0) {
+                result = -1;
+                break;
+            }
+            done += w;
+        }
+        if (result != 0 || n < COPY_CHUNK) {
+            break;
+        }
+    }
+
+    free(buffer);
+    close(in);
+    if (close(out) != 0) {
+        result = -1;
+    }
+    if (result != 0) {
+        unlink(dst);
+    }
+    return result;
+}
+
+/**
+ * Append to the recording's playlist
+ */
+static int append_playlist(const hls_recording_t *recording, const char *text) {
+    char path[MAX_PATH_LENGTH];
+    snprintf(path, sizeof(path), "%s/" HLS_RECORDING_PLAYLIST_NAME, recording->dir);
+
+    FILE *file = fopen(path, "a");
+    if (!file) {
+        return -1;
+    }
+    int result = fputs(text, file) < 0 ? -1 : 0;
+    if (fclose(file) != 0) {
+        result = -1;
+    }
+    return result;
+}
+
+/**
+ * Start a recording with the segment about to be added
+ *
+ * @param init_path init.mp4 written by the muxer next to the segment
+ * @param start_time Wall clock time the segment starts at
+ */
+static int start_recording(hls_recording_t *recording, const AVFormatContext *muxer,
+                           const char *init_path, time_t start_time) {
+    // Next to the stream's MP4 recordings, named the same way
+    char base[MAX_PATH_LENGTH];
+    if (recording_layout_dir(recording->stream_name, start_time, base, sizeof(base)) != 0) {
+        return -1;
+    }
+
+    char timestamp[32];
+    struct tm tm;
+    localtime_r(&start_time, &tm);
+    strftime(timestamp, sizeof(timestamp), "%Y%m%d_%H%M%S", &tm);
+
+    // A recording started within the same second as the last one gets a suffix
+    int n = snprintf(recording->dir, sizeof(recording->dir), "%s/" HLS_RECORDING_DIR_PREFIX "%s", base, timestamp);
+    for (int i = 1; n > 0 && (size_t)n < sizeof(recording->dir) && access(recording->dir, F_OK) == 0; i++) {
+        n = snprintf(recording->dir, sizeof(recording->dir), "%s/" HLS_RECORDING_DIR_PREFIX "%s_%d",
+                     base, timestamp, i);
+    }
+
+    recording_metadata_t metadata = {0};
+    if (n < 0 || (size_t)n + sizeof("/" HLS_RECORDING_PLAYLIST_NAME) > sizeof(metadata.file_path)) {
+        log_error("Recording path of stream %s is too long", recording->stream_name);
+        return -1;
+    }
+    if (make_dirs(recording->dir) != 0) {
+        log_error("Failed to create recording directory %s: %s", recording->dir, strerror(errno));
+        return -1;
+    }
+
+    // The muxer writes init.mp4 once per output, so it is copied rather than linked
+    char path[MAX_PATH_LENGTH];
+    snprintf(path, sizeof(path), "%s/" HLS_RECORDING_INIT_NAME, recording->dir);
+    if (copy_file(init_path, path) != 0) {
+        log_error("Failed to copy %s into recording %s: %s", init_path, recording->dir, strerror(errno));
+        rmdir(recording->dir);
+        return -1;
+    }
+
+    char header[256];
+    snprintf(header, sizeof(header),
+             "#EXTM3U\n"
+             "#EXT-X-VERSION:7\n"
+             "#EXT-X-TARGETDURATION:%d\n"
+             "#EXT-X-MEDIA-SEQUENCE:0\n"
+             "#EXT-X-PLAYLIST-TYPE:EVENT\n"
+             "#EXT-X-INDEPENDENT-SEGMENTS\n"
+             "#EXT-X-MAP:URI=\"" HLS_RECORDING_INIT_NAME "\"\n",
+             HLS_RECORDING_TARGET_DURATION);
+    if (append_playlist(recording, header) != 0) {
+        log_error("Failed to write the playlist of recording %s: %s", recording->dir, strerror(errno));
+        unlink(path);
+        rmdir(recording->dir);
+        return -1;
+    }
+
+    snprintf(metadata.stream_name, sizeof(metadata.stream_name), "%s", recording->stream_name);
+    snprintf(metadata.file_path, sizeof(metadata.file_path), "%s/" HLS_RECORDING_PLAYLIST_NAME, recording->dir);
+    metadata.start_time = start_time;
+    for (unsigned int i = 0; muxer && i < muxer->nb_streams; i++) {
+        const AVStream *stream = muxer->streams[i];
+        if (stream && stream->codecpar && stream->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
+            metadata.width = stream->codecpar->width;
+            metadata.height = stream->codecpar->height;
+            if (stream->avg_frame_rate.num > 0 && stream->avg_frame_rate.den > 0) {
+                metadata.fps = (int)(av_q2d(stream->avg_frame_rate) + 0.5);
+            }
+            snprintf(metadata.codec, sizeof(metadata.codec), "%s", avcodec_get_name(stream->codecpar->codec_id));
+            break;
+        }
+    }
+
+    recording->id = add_recording_metadata(&metadata);
+    if (recording->id == 0) {
+        log_error("Failed to add recording %s to the database", metadata.file_path);
+        hls_recording_unlink(metadata.file_path);
+        return -1;
+    }
+
+    recording->start_time = start_time;
+    recording->sequence = 0;
+    recording->duration_ms = 0;
+    recording->size_bytes = 0;
+    log_info("Started HLS recording %llu of stream %s in %s", (unsigned long long)recording->id,
+             recording->stream_name, recording->dir);
+    return 0;
+}
+
+/**
+ * Finish the current recording
+ */
+static void finish_recording(hls_recording_t *recording) {
+    if (recording->id == 0) {
+        return;
+    }
+
+    if (append_playlist(recording, "#EXT-X-ENDLIST\n") != 0) {
+        log_warn("Failed to end the playlist of recording %s: %s", recording->dir, strerror(errno));
+    }
+
+    time_t end_time = recording->start_time + (time_t)((recording->duration_ms + 999) / 1000);
+    if (update_recording_metadata(recording->id, end_time, recording->size_bytes, true) != 0) {
+        log_warn("Failed to finish recording %llu of stream %s", (unsigned long long)recording->id,
+                 recording->stream_name);
+    } else {
+        char path[MAX_PATH_LENGTH];
+        snprintf(path, sizeof(path), "%s/" HLS_RECORDING_PLAYLIST_NAME, recording->dir);
+        recording_thumbnails_queue(recording->id, path);
+    }
+
+    log_info("Finished HLS recording %llu of stream %s: %d segments, %lld ms",
+             (unsigned long long)recording->id, recording->stream_name, recording->sequence,
+             (long long)recording->duration_ms);
+    recording->id = 0;
+}
+
+hls_recording_t *hls_recording_create(const char *stream_name, int max_duration) {
+    if (!stream_name) {
+        return NULL;
+    }
+
+    hls_recording_t *recording = calloc(1, sizeof(hls_recording_t));
+    if (!recording) {
+        log_error("Failed to allocate HLS recording of stream %s", stream_name);
+        return NULL;
+    }
+
+    snprintf(recording->stream_name, sizeof(recording->stream_name), "%s", stream_name);
+    recording->max_duration = max_duration > 0 ? max_duration : HLS_RECORDING_DEFAULT_DURATION;
+    log_info("Stream %s records its HLS segments, %d seconds per recording", stream_name,
+             recording->max_duration);
+    return recording;
+}
+
+void hls_recording_add_segment(hls_recording_t *recording, const AVFormatContext *muxer,
+                               const char *segment_path, double duration, int64_t size) {
+    if (!recording || !segment_path || size <= 0) {
+        return;
+    }
+
+    // Without timestamps the segment lasts until it was closed
+    time_t now = time(NULL);
+    int64_t duration_ms = (int64_t)(duration * 1000.0 + 0.5);
+    if (duration_ms <= 0) {
+        duration_ms = recording->last_segment_time > 0 && now > recording->last_segment_time ?
+                      (int64_t)(now - recording->last_segment_time) * 1000 : 1000;
+    }
+    recording->last_segment_time = now;
+
+    if (recording->id == 0) {
+        char init_path[MAX_PATH_LENGTH];
+        const char *slash = strrchr(segment_path, '/');
+        int len = slash ? (int)(slash - segment_path) : 1;
+        snprintf(init_path, sizeof(init_path), "%.*s/" HLS_RECORDING_INIT_NAME, len, slash ? segment_path : ".");
+        if (start_recording(recording, muxer, init_path, now - (time_t)(duration_ms / 1000)) != 0) {
+            return;
+        }
+    }
+
+    recording_segment_t segment = {
+        .sequence = recording->sequence,
+        .start_ms = recording->duration_ms,
+        .duration_ms = duration_ms,
+        .size_bytes = (uint64_t)size
+    };
+    snprintf(segment.file_name, sizeof(segment.file_name), "%d.m4s", recording->sequence);
+
+    // A hard link keeps the segment after the muxer deletes it from the live
+    // playlist, without writing it again
+    char path[MAX_PATH_LENGTH];
+    snprintf(path, sizeof(path), "%s/%s", recording->dir, segment.file_name);
+    if (link(segment_path, path) != 0) {
+        if (errno != EXDEV && errno != EPERM && errno != EMLINK) {
+            log_warn("Failed to keep segment %s in recording %s: %s", segment_path, recording->dir,
+                     strerror(errno));
+            return;
+        }
+        if (!recording->copy_warned) {
+            log_warn("HLS segments of stream %s are copied into its recordings: %s; keep the HLS "
+                     "directory on the recordings' file system to save the writes",
+                     recording->stream_name, strerror(errno));
+            recording->copy_warned = true;
+        }
+        if (copy_file(segment_path, path) != 0) {
+            log_warn("Failed to copy segment %s into recording %s: %s", segment_path, recording->dir,
+                     strerror(errno));
+            return;
+        }
+    }
+
+    char entry[128];
+    snprintf(entry, sizeof(entry), "#EXTINF:%.3f,\n%s\n", duration_ms / 1000.0, segment.file_name);
+    if (append_playlist(recording, entry) != 0) {
+        log_warn("Failed to add segment %s to the playlist of recording %s: %s", segment.file_name,
+                 recording->dir, strerror(errno));
+    }
+
+    time_t end_time = recording->start_time + (time_t)((recording->duration_ms + duration_ms + 999) / 1000);
+    if (add_recording_segment(recording->id, &segment, end_time) != 0) {
+        // Most likely deleted while in progress; the next segment starts a new recording
+        log_warn("Failed to index segment %d of recording %llu, starting a new recording",
+                 segment.sequence, (unsigned long long)recording->id);
+        recording->id = 0;
+        return;
+    }
+
+    recording->sequence++;
+    recording->duration_ms += duration_ms;
+    recording->size_bytes += (uint64_t)size;
+
+    if (recording->duration_ms >= (int64_t)recording->max_duration * 1000) {
+        finish_recording(recording);
+    }
+}
+
+void hls_recording_close(hls_recording_t *recording) {
+    if (!recording) {
+        return;
+    }
+    finish_recording(recording);
+    free(recording);
+}
+
+int hls_recording_get_files(uint64_t id, const char *file_path, int64_t from_ms,
+                            hls_recording_files_t *files) {
+    if (!files) {
+        return -1;
+    }
+    memset(files, 0, sizeof(*files));
+
+    char dir[MAX_PATH_LENGTH];
+    if (!recording_dir(file_path, dir, sizeof(dir))) {
+        return -1;
+    }
+
+    recording_segment_t *segments = NULL;
+    int count = get_recording_segments(id, &segments);
+    if (count <= 0) {
+        return -1;
+    }
+
+    // Start at the segment covering from_ms
+    int first = 0;
+    while (first < count - 1 && segments[first].start_ms + segments[first].duration_ms <= from_ms) {
+        first++;
+    }
+
+    files->paths = calloc((size_t)(count - first + 1), sizeof(char *));
+    if (!files->paths) {
+        free(segments);
+        return -1;
+    }
+
+    int result = asprintf(&files->paths[files->count++], "%s/" HLS_RECORDING_INIT_NAME, dir) < 0 ? -1 : 0;
+    for (int i = first; i < count && result == 0; i++) {
+        if (asprintf(&files->paths[files->count++], "%s/%s", dir, segments[i].file_name) < 0) {
+            result = -1;
+        }
+    }
+    files->start_ms = segments[first].start_ms;
+
+    free(segments);
+    if (result != 0) {
+        // asprintf leaves the pointer undefined on failure
+        files->paths[--files->count] = NULL;
+        hls_recording_free_files(files);
+    }
+    return result;
+}
+
+void hls_recording_free_files(hls_recording_files_t *files) {
+    if (!files) {
+        return;
+    }
+    for (int i = 0; i < files->count; i++) {
+        free(files->paths[i]);
+    }
+    free(files->paths);
+    memset(files, 0, sizeof(*files));
+}
+
+int hls_recording_resource_path(const char *file_path, const char *file_name, char *path, size_t size) {
+    char dir[MAX_PATH_LENGTH];
+    if (!file_name || !recording_dir(file_path, dir, sizeof(dir))) {
+        return -1;
+    }
+
+    // Only names the recording's files can have, so no other file is reachable
+    if (strcmp(file_name, HLS_RECORDING_INIT_NAME) != 0) {
+        int index = -1;
+        char canonical[32];
+        if (sscanf(file_name, "%d.m4s", &index) != 1 || index < 0) {
+            return -1;
+        }
+        snprintf(canonical, sizeof(canonical), "%d.m4s", index);
+        if (strcmp(canonical, file_name) != 0) {
+            return -1;
+        }
+    }
+
+    int n = snprintf(path, size, "%s/%s", dir, file_name);
+    return (n > 0 && (size_t)n < size) ? 0 : -1;
+}
+
+int hls_recording_unlink(const char *file_path) {
+    char dir[MAX_PATH_LENGTH];
+    if (!recording_dir(file_path, dir, sizeof(dir))) {
+        return unlink(file_path);
+    }
+
+    DIR *d = opendir(dir);
+    if (!d) {
+        return -1;
+    }
+
+    // The directory only ever holds the recording's own files
+    int result = 0;
+    int saved_errno = 0;
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        char path[MAX_PATH_LENGTH];
+        snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+        if (unlink(path) != 0 && errno != ENOENT) {
+            saved_errno = errno;
+            result = -1;
+        }
+    }
+    closedir(d);
+
+    if (result == 0 && rmdir(dir) != 0 && errno != ENOENT) {
+        saved_errno = errno;
+        result = -1;
+    }
+    if (result != 0) {
+        errno = saved_errno;
+    }
+    return result;
+}
+
+int hls_recording_finalize(const recording_metadata_t *recording) {
+    if (!recording || !hls_recording_is_segmented(recording->file_path)) {
+        return -1;
+    }
+
+    recording_segment_t *segments = NULL;
+    int count = get_recording_segments(recording->id, &segments);
+    if (count <= 0) {
+        return -1;
+    }
+
+    int64_t duration_ms = 0;
+    uint64_t size_bytes = 0;
+    for (int i = 0; i < count; i++) {
+        duration_ms += segments[i].duration_ms;
+        size_bytes += segments[i].size_bytes;
+    }
+    free(segments);
+
+    // The playlist may list a segment linked after the last one indexed;
+    // playback goes by the index, FFmpeg reads the extra segment
+    FILE *file = fopen(recording->file_path, "a");
+    if (file) {
+        fputs("#EXT-X-ENDLIST\n", file);
+        fclose(file);
+    }
+
+    time_t end_time = recording->start_time + (time_t)((duration_ms + 999) / 1000);
+    return update_recording_metadata(recording->id, end_time, size_bytes, true);
+}
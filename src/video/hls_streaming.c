@@ -18,6 +18,8 @@
 #include "video/hls/hls_unified_thread.h"
 #include "video/hls/hls_context.h"
 #include "video/hls/hls_directory.h"
+#include "video/hls/hls_mosaic.h"
+#include "video/stream_arena.h"
 
 // Forward declarations for the unified thread implementation
 extern pthread_mutex_t unified_contexts_mutex;
@@ -25,7 +27,6 @@ extern hls_unified_thread_ctx_t *unified_contexts[MAX_STREAMS];
 
 // Forward declarations for memory management functions
 extern void mark_context_as_freed(void *ctx);
-extern void *safe_free(void *ptr);
 
 /**
  * Initialize HLS streaming backend
@@ -41,6 +42,9 @@ void init_hls_streaming_backend(void) {
     }
     pthread_mutex_unlock(&unified_contexts_mutex);
 
+    // Deletes what stream starts and stops move aside, and what the last run left
+    start_hls_cleanup_worker();
+
     log_info("HLS streaming backend initialized with unified thread architecture");
 }
 
@@ -50,6 +54,9 @@ void init_hls_streaming_backend(void) {
 void cleanup_hls_streaming_backend(void) {
     log_info("Cleaning up HLS streaming backend...");
 
+    // The mosaic reads from the streams' ingests, so it goes first
+    hls_mosaic_stop();
+
     // Create a local copy of all stream names that need to be stopped
     // CRITICAL FIX: Use a more robust approach to track unique stream names
     char stream_names[MAX_STREAMS][MAX_STREAM_NAME];
@@ -189,9 +196,8 @@ void cleanup_hls_streaming_backend(void) {
                             extern void mark_context_as_freed(void *ctx);
                             mark_context_as_freed(unified_contexts[j]);
 
-                            // CRITICAL FIX: Use safe_free to free the context
-                            extern void *safe_free(void *ptr);
-                            safe_free(unified_contexts[j]);
+                            // Return the context to the stream's arena
+                            stream_arena_free(unified_contexts[j]);
                             unified_contexts[j] = NULL;
                             break;
                         }
@@ -239,9 +245,8 @@ void cleanup_hls_streaming_backend(void) {
             extern void mark_context_as_freed(void *ctx);
             mark_context_as_freed(unified_contexts[i]);
 
-            // CRITICAL FIX: Use safe_free to free the context
-            extern void *safe_free(void *ptr);
-            safe_free(unified_contexts[i]);
+            // Return the context to the stream's arena
+            stream_arena_free(unified_contexts[i]);
             unified_contexts[i] = NULL;
         }
     }
@@ -251,5 +256,7 @@ void cleanup_hls_streaming_backend(void) {
         log_info("All HLS contexts successfully cleaned up");
     }
 
+    stop_hls_cleanup_worker();
+
     log_info("HLS streaming backend cleaned up");
 }
@@ -6,7 +6,6 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
-#include <dirent.h>
 #include <sys/stat.h>
 #include <pthread.h>
 #include <time.h>
@@ -17,9 +16,14 @@
 #include <libavcodec/avcodec.h>
 #include <libavutil/avutil.h>
 #include <libavutil/time.h>
+#include <libavutil/opt.h>
 
 #include "core/logger.h"
+#include "core/metrics.h"
 #include "video/hls_writer.h"
+#include "video/hls/hls_segment_index.h"
+#include "storage/storage_io.h"
+#include "storage/storage_latency.h"
 #include "video/detection_integration.h"
 #include "video/detection_frame_processing.h"
 #include "video/streams.h"
@@ -34,116 +38,168 @@ static int ensure_output_directory(hls_writer_t *writer);
 static void register_hls_writer(hls_writer_t *writer);
 static void unregister_hls_writer(hls_writer_t *writer);
 
+// Number of segments in the playlist; FFmpeg keeps one more on disk before deleting
+#define HLS_PLAYLIST_SIZE 3
+
+// Default I/O callbacks of the muxer, the same for every output context
+static int (*default_io_open)(AVFormatContext *s, AVIOContext **pb, const char *url,
+                              int flags, AVDictionary **options) = NULL;
+#if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(59, 17, 100)
+static int (*default_io_close2)(AVFormatContext *s, AVIOContext *pb) = NULL;
+#else
+static void (*default_io_close)(AVFormatContext *s, AVIOContext *pb) = NULL;
+#endif
+
 /**
- * Clean up old HLS segments that are no longer in the playlist
+ * Check whether a URL opened by the muxer is a media segment
  */
-static void cleanup_old_segments(const char *output_dir, int max_segments) {
-    DIR *dir;
-    struct dirent *entry;
-    struct stat st;
-    char filepath[HLS_MAX_PATH_LENGTH];
-
-    // Keep track of segments to delete
-    typedef struct {
-        char filename[256];
-        time_t mtime;
-    } segment_info_t;
-
-    segment_info_t *segments = NULL;
-    int segment_count = 0;
-    int actual_count = 0;
-
-    // Open directory
-    dir = opendir(output_dir);
-    if (!dir) {
-        log_error("Failed to open directory for cleanup: %s", output_dir);
-        return;
+static bool is_segment_url(const char *url) {
+    const char *ext = url ? strrchr(url, '.') : NULL;
+    return ext && (strcmp(ext, ".ts") == 0 || strcmp(ext, ".m4s") == 0);
+}
+
+/**
+ * Check whether a URL opened by the muxer is the playlist (or its temporary file)
+ */
+static bool is_playlist_url(const char *url) {
+    return url && strstr(url, ".m3u8") != NULL;
+}
+
+/**
+ * Record the segment the muxer just closed in the segment index
+ * Runs on the writing thread, from inside av_interleaved_write_frame or av_write_trailer.
+ */
+static void record_segment(hls_writer_t *writer, AVFormatContext *s, int64_t size, AVBufferRef *data) {
+    hls_segment_info_t segment = {0};
+
+    strncpy(segment.path, writer->segment_path, MAX_PATH_LENGTH - 1);
+    segment.path[MAX_PATH_LENGTH - 1] = '\0';
+    segment.sequence = writer->segment_sequence++;
+    segment.size = size;
+    segment.completed_time = time(NULL);
+
+    // The muxer splits on the keyframe that starts the next segment, which is the
+    // last packet passed to it, so the segment spans from its start to that packet
+    if (s->nb_streams > 0 && s->streams[0] &&
+        writer->segment_start_pts != AV_NOPTS_VALUE && writer->last_pts != AV_NOPTS_VALUE) {
+        AVRational time_base = s->streams[0]->time_base;
+        segment.duration = (writer->last_pts - writer->segment_start_pts) * av_q2d(time_base);
+        segment.keyframe_pts = av_rescale_q(writer->segment_start_pts, time_base, (AVRational){1, 90000});
     }
+    writer->segment_start_pts = writer->last_pts;
 
-    // Count segment files first
-    while ((entry = readdir(dir)) != NULL) {
-        // Check for both .ts and .m4s files (support both formats)
-        if (strstr(entry->d_name, ".m4s") != NULL || strstr(entry->d_name, ".ts") != NULL) {
-            segment_count++;
-        }
+    hls_segment_index_add(writer->stream_name, writer, &segment, data);
+
+    if (!data) {
+        hls_recording_add_segment(writer->recording, s, writer->segment_path, segment.duration, size);
     }
+}
 
-    // If we don't have more than the max, no cleanup needed
-    if (segment_count <= max_segments) {
-        closedir(dir);
-        return;
+/**
+ * Open callback of the muxer, remembers the segment being written
+ */
+static int hls_io_open(AVFormatContext *s, AVIOContext **pb, const char *url,
+                       int flags, AVDictionary **options) {
+    hls_writer_t *writer = (hls_writer_t *)s->opaque;
+    bool is_segment = writer && (flags & AVIO_FLAG_WRITE) && is_segment_url(url);
+
+    if (is_segment && strncmp(url, "file:", 5) == 0) {
+        url += 5;
     }
 
-    // Allocate array for segment info with proper alignment
-    // Use calloc instead of malloc to ensure memory is initialized to zero
-    segments = (segment_info_t *)calloc(segment_count, sizeof(segment_info_t));
-    if (!segments) {
-        log_error("Failed to allocate memory for segment cleanup");
-        closedir(dir);
-        return;
+    // Segments kept in memory are written to a growing buffer instead of a file,
+    // others through the storage I/O thread so a slow disk does not stall the muxer.
+    // While the disk is rated critical, live segments are kept in memory too and
+    // it is left to the recordings; segments that are recordings must go to disk
+    bool in_memory = is_segment &&
+                     (writer->memory_store ||
+                      (!writer->recording &&
+                       storage_latency_level_of_path(writer->output_dir) >= STORAGE_LATENCY_CRITICAL));
+    int ret = -1;
+    if (in_memory) {
+        ret = avio_open_dyn_buf(pb);
+    } else if (is_segment) {
+        ret = storage_io_open_avio(pb, url, 0);
+    }
+    if (ret < 0 && !in_memory) {
+        ret = default_io_open(s, pb, url, flags, options);
     }
 
-    // Rewind directory
-    rewinddir(dir);
+    if (ret >= 0 && is_segment) {
+        writer->segment_pb = *pb;
+        writer->segment_in_memory = in_memory;
+        strncpy(writer->segment_path, url, MAX_PATH_LENGTH - 1);
+        writer->segment_path[MAX_PATH_LENGTH - 1] = '\0';
+    }
+    if (ret >= 0 && writer && (flags & AVIO_FLAG_WRITE) && is_playlist_url(url)) {
+        writer->playlist_pb = *pb;
+    }
 
-    // Collect segment info
-    int i = 0;
-    while ((entry = readdir(dir)) != NULL && i < segment_count) {
-        // Check for both .ts and .m4s files (support both formats)
-        if (strstr(entry->d_name, ".m4s") == NULL && strstr(entry->d_name, ".ts") == NULL) {
-            continue;
-        }
+    return ret;
+}
 
-        // Get file stats
-        snprintf(filepath, sizeof(filepath), "%s/%s", output_dir, entry->d_name);
-        if (stat(filepath, &st) == 0) {
-            strncpy(segments[i].filename, entry->d_name, 255);
-            segments[i].filename[255] = '\0';
-            segments[i].mtime = st.st_mtime;
-            i++;
+/**
+ * Close callback of the muxer, indexes the segment once it is complete on disk
+ */
+#if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(59, 17, 100)
+static int hls_io_close2(AVFormatContext *s, AVIOContext *pb) {
+#else
+static void hls_io_close(AVFormatContext *s, AVIOContext *pb) {
+#endif
+    hls_writer_t *writer = (hls_writer_t *)s->opaque;
+    bool is_segment = writer && pb && pb == writer->segment_pb;
+    bool is_playlist = writer && pb && pb == writer->playlist_pb;
+    int64_t size = is_segment ? avio_tell(pb) : 0;
+    uint64_t started_us = is_segment ? metrics_now_us() : 0;
+    AVBufferRef *data = NULL;
+    int ret = 0;
+
+    if (storage_io_is_avio(pb)) {
+        // Returns once the segment is on disk, before it is indexed and served
+        int64_t written = storage_io_close_avio(&pb);
+        ret = written < 0 ? (int)written : 0;
+    } else if (is_segment && writer->segment_in_memory) {
+        uint8_t *buffer = NULL;
+        int buffer_size = avio_close_dyn_buf(pb, &buffer);
+        data = buffer ? av_buffer_create(buffer, buffer_size, av_buffer_default_free, NULL, 0) : NULL;
+        if (!data) {
+            av_free(buffer);
+            log_warn("Failed to keep HLS segment %s of stream %s in memory",
+                    writer->segment_path, writer->stream_name);
         }
+    } else {
+#if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(59, 17, 100)
+        ret = default_io_close2(s, pb);
+#else
+        default_io_close(s, pb);
+#endif
     }
 
-    // Store the actual number of segments we found
-    actual_count = i;
+    if (is_segment) {
+        writer->segment_pb = NULL;
+        record_segment(writer, s, size, data);
+        metrics_observe_since(writer->segment_metric, started_us);
 
-    closedir(dir);
-
-    // Sort segments by modification time (oldest first)
-    // Simple bubble sort for now
-    for (int j = 0; j < actual_count - 1; j++) {
-        for (int k = 0; k < actual_count - j - 1; k++) {
-            if (segments[k].mtime > segments[k + 1].mtime) {
-                segment_info_t temp = segments[k];
-                segments[k] = segments[k + 1];
-                segments[k + 1] = temp;
-            }
-        }
+        // The muxer splits on the key frame just passed to it, which starts the next segment
+        pipeline_trace_stage(writer->segment_close_metric, &writer->segment_trace);
+        writer->closed_trace = writer->segment_trace;
+        writer->segment_trace = writer->packet_trace;
     }
 
-    // Delete oldest segments beyond our limit
-    int to_delete = actual_count - max_segments;
-    if (to_delete > 0 && to_delete <= actual_count) { // Safety check to prevent out-of-bounds access
-        for (int j = 0; j < to_delete && j < actual_count; j++) { // Additional bounds check
-            // Ensure filename is valid before using it
-            if (segments[j].filename[0] != '\0') {
-                snprintf(filepath, sizeof(filepath), "%s/%s", output_dir, segments[j].filename);
-                if (unlink(filepath) == 0) {
-                    log_debug("Deleted old HLS segment: %s", segments[j].filename);
-                } else {
-                    log_warn("Failed to delete old HLS segment: %s (error: %s)",
-                            segments[j].filename, strerror(errno));
-                }
-            }
-        }
+    // The segment becomes playable once a playlist listing it is written
+    if (is_playlist) {
+        writer->playlist_pb = NULL;
+        pipeline_trace_stage(writer->playlist_metric, &writer->closed_trace);
+        memset(&writer->closed_trace, 0, sizeof(writer->closed_trace));
     }
 
-    // Always free the allocated memory
-    free(segments);
-    segments = NULL;
+#if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(59, 17, 100)
+    return ret;
+#endif
 }
 
-hls_writer_t *hls_writer_create(const char *output_dir, const char *stream_name, int segment_duration) {
+hls_writer_t *hls_writer_create(const char *output_dir, const char *stream_name, int segment_duration,
+                                hls_segment_format_t segment_format) {
     // Check if a writer for this stream already exists
     hls_writer_t *existing_writer = find_hls_writer_by_stream_name(stream_name);
     if (existing_writer) {
@@ -177,7 +233,17 @@ hls_writer_t *hls_writer_create(const char *output_dir, const char *stream_name,
     }
 
     writer->segment_duration = segment_duration;
+    writer->segment_format = segment_format;
     writer->last_cleanup_time = time(NULL);
+    writer->packet_pool = packet_pool_acquire(stream_name);
+    writer->segment_start_pts = AV_NOPTS_VALUE;
+    writer->last_pts = AV_NOPTS_VALUE;
+    writer->memory_store = g_config.hls_memory_store;
+    writer->segment_metric = metrics_histogram("lightnvr_hls_segment_write_seconds",
+                                               "Time to finish writing an HLS segment and index it",
+                                               "stream", stream_name, NULL);
+    writer->segment_close_metric = pipeline_trace_metric(stream_name, PIPELINE_STAGE_SEGMENT_CLOSE);
+    writer->playlist_metric = pipeline_trace_metric(stream_name, PIPELINE_STAGE_PLAYLIST_UPDATE);
 
     // Initialize mutex
     pthread_mutex_init(&writer->mutex, NULL);
@@ -206,6 +272,23 @@ hls_writer_t *hls_writer_create(const char *output_dir, const char *stream_name,
         return NULL;
     }
 
+    // Track the segments the muxer writes so they can be indexed
+    if (!default_io_open) {
+        default_io_open = writer->output_ctx->io_open;
+#if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(59, 17, 100)
+        default_io_close2 = writer->output_ctx->io_close2;
+#else
+        default_io_close = writer->output_ctx->io_close;
+#endif
+    }
+    writer->output_ctx->opaque = writer;
+    writer->output_ctx->io_open = hls_io_open;
+#if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(59, 17, 100)
+    writer->output_ctx->io_close2 = hls_io_close2;
+#else
+    writer->output_ctx->io_close = hls_io_close;
+#endif
+
     // Set HLS options - optimized for stability and compatibility
     AVDictionary *options = NULL;
     char hls_time[16];
@@ -214,13 +297,27 @@ hls_writer_t *hls_writer_create(const char *output_dir, const char *stream_name,
     // CRITICAL FIX: Modify HLS options to prevent segmentation faults
     // Use more conservative settings that prioritize stability over low latency
     av_dict_set(&options, "hls_time", hls_time, 0);
-    av_dict_set(&options, "hls_list_size", "3", 0);  // Reduced for faster segment cleanup
-
-    // Use MPEG-TS segments for better compatibility and to avoid MP4 moov atom issues
-    av_dict_set(&options, "hls_segment_type", "mpegts", 0);
-
-    // Enable aggressive segment deletion to prevent accumulation
-    av_dict_set(&options, "hls_flags", "delete_segments+discont_start+program_date_time", 0);
+    char hls_list_size[16];
+    snprintf(hls_list_size, sizeof(hls_list_size), "%d", HLS_PLAYLIST_SIZE);
+    av_dict_set(&options, "hls_list_size", hls_list_size, 0);  // Reduced for faster segment cleanup
+
+    // MPEG-TS segments by default; fMP4 segments share one init segment (EXT-X-MAP)
+    // and are fragmented as CMAF, so players append them to MSE without transmuxing
+    bool fmp4 = writer->segment_format == HLS_SEGMENT_FMP4;
+    const char *segment_type = fmp4 ? "fmp4" : "mpegts";
+    av_dict_set(&options, "hls_segment_type", segment_type, 0);
+    if (fmp4) {
+        av_dict_set(&options, "hls_fmp4_init_filename", "init.mp4", 0);
+        av_dict_set(&options, "hls_segment_options", "movflags=+cmaf", 0);
+    }
+
+    // Enable aggressive segment deletion to prevent accumulation; segments kept in
+    // memory are never written, so there is nothing for the muxer to delete.
+    // Every segment starts on a key frame, which fMP4 playlists declare
+    char hls_flags[128];
+    snprintf(hls_flags, sizeof(hls_flags), "%sdiscont_start+program_date_time%s",
+             writer->memory_store ? "" : "delete_segments+", fmp4 ? "+independent_segments" : "");
+    av_dict_set(&options, "hls_flags", hls_flags, 0);
 
     // Set start number
     av_dict_set(&options, "start_number", "0", 0);
@@ -231,19 +328,23 @@ hls_writer_t *hls_writer_create(const char *output_dir, const char *stream_name,
     // Add additional options to prevent segmentation faults
     av_dict_set(&options, "avoid_negative_ts", "make_non_negative", 0);
 
-    // Set segment filename format for MPEG-TS
-    char segment_format[MAX_PATH_LENGTH + 32];
-    snprintf(segment_format, sizeof(segment_format), "%s/segment_%%d.ts", writer->output_dir);
-    av_dict_set(&options, "hls_segment_filename", segment_format, 0);
+    // Set segment filename format
+    char segment_filename[MAX_PATH_LENGTH + 32];
+    snprintf(segment_filename, sizeof(segment_filename), "%s/segment_%%d.%s", writer->output_dir, fmp4 ? "m4s" : "ts");
+    av_dict_set(&options, "hls_segment_filename", segment_filename, 0);
 
     // Log simplified options for debugging
     log_info("HLS writer options for stream %s (simplified for stability):", writer->stream_name);
     log_info("  hls_time: %s", hls_time);
-    log_info("  hls_list_size: 5");
-    log_info("  hls_flags: delete_segments+independent_segments");
-    log_info("  hls_segment_type: mpegts");
+    log_info("  hls_list_size: %s", hls_list_size);
+    log_info("  hls_flags: %s", hls_flags);
+    log_info("  hls_segment_type: %s", segment_type);
     log_info("  start_number: 0");
-    log_info("  hls_segment_filename: %s", segment_format);
+    log_info("  hls_segment_filename: %s", segment_filename);
+
+    // The muxer options take effect only when set on the context; avio_open2 just
+    // consumes the protocol options left over
+    av_opt_set_dict2(writer->output_ctx, &options, AV_OPT_SEARCH_CHILDREN);
 
     // Open output file
     ret = avio_open2(&writer->output_ctx->pb, output_path,
@@ -267,6 +368,10 @@ hls_writer_t *hls_writer_create(const char *output_dir, const char *stream_name,
     // Register the writer for global tracking
     register_hls_writer(writer);
 
+    // Completed segments, plus the one FFmpeg keeps past the playlist before deleting it.
+    // Kept in memory, that last one still covers players that fetched the previous playlist
+    hls_segment_index_open(writer->stream_name, writer->output_dir, HLS_PLAYLIST_SIZE + 1, writer);
+
     return writer;
 }
 
@@ -300,6 +405,20 @@ int hls_writer_initialize(hls_writer_t *writer, const AVStream *input_stream) {
     // Set stream time base
     out_stream->time_base = input_stream->time_base;
 
+    // The muxer gets the parameters of the filtered packets, e.g. Annex B extradata.
+    // The MP4 muxer takes either form and writes length-prefixed samples itself
+    if (writer->segment_format != HLS_SEGMENT_FMP4) {
+        annexb_filter_configure(&writer->annexb_filter, input_stream->codecpar, input_stream->time_base);
+        const AVCodecParameters *filtered_par = annexb_filter_output_parameters(&writer->annexb_filter);
+        if (filtered_par) {
+            ret = avcodec_parameters_copy(out_stream->codecpar, filtered_par);
+            if (ret < 0) {
+                log_error("Failed to copy filtered codec parameters for stream %s", writer->stream_name);
+                return ret;
+            }
+        }
+    }
+
     //  For HLS streaming, we need to set the correct codec parameters
     // The issue is not with the bitstream filter but with how we're configuring the output
 
@@ -331,6 +450,11 @@ int hls_writer_initialize(hls_writer_t *writer, const AVStream *input_stream) {
         log_info("Stream %s is not H.264, using default codec parameters", writer->stream_name);
     }
 
+    // Safari plays HEVC from fMP4 only when the track is tagged hvc1 rather than hev1
+    if (writer->segment_format == HLS_SEGMENT_FMP4 && input_stream->codecpar->codec_id == AV_CODEC_ID_HEVC) {
+        out_stream->codecpar->codec_tag = MKTAG('h', 'v', 'c', '1');
+    }
+
     // Write the header
     AVDictionary *options = NULL;
     ret = avformat_write_header(writer->output_ctx, &options);
@@ -344,6 +468,15 @@ int hls_writer_initialize(hls_writer_t *writer, const AVStream *input_stream) {
 
     av_dict_free(&options);
 
+    // The packager follows the muxer's stream, so it is created once the header fixed its time base
+    if (g_config.hls_low_latency && !writer->ll_packager) {
+        writer->ll_packager = hls_ll_packager_create(writer->stream_name, writer->output_ctx->streams[0],
+                                                     writer->segment_duration, g_config.hls_part_duration_ms);
+        if (!writer->ll_packager) {
+            log_warn("Low-Latency HLS unavailable for stream %s, serving regular HLS only", writer->stream_name);
+        }
+    }
+
     // Let FFmpeg handle manifest file creation
     log_info("Initialized HLS writer for stream %s", writer->stream_name);
     writer->initialized = 1;
@@ -505,15 +638,6 @@ int hls_writer_write_packet(hls_writer_t *writer, const AVPacket *pkt, const AVS
         return -1;
     }
 
-    // Clone the packet with additional safety checks
-    // Use av_packet_alloc instead of stack allocation to ensure proper alignment
-    AVPacket *out_pkt_ptr = av_packet_alloc();
-    if (!out_pkt_ptr) {
-        log_error("Failed to allocate packet for stream %s", writer->stream_name);
-        return -1;
-    }
-    // out_pkt_ptr is already initialized by av_packet_alloc
-
     // Verify packet data is valid before referencing
     if (!pkt->data || pkt->size <= 0) {
         log_warn("Invalid packet data for stream %s (data=%p, size=%d)",
@@ -521,80 +645,35 @@ int hls_writer_write_packet(hls_writer_t *writer, const AVPacket *pkt, const AVS
         return -1;
     }
 
+    // Clone the packet into a pooled packet instead of allocating one per write
+    AVPacket *out_pkt_ptr = packet_pool_get_packet(writer->packet_pool);
+    if (!out_pkt_ptr) {
+        log_error("Failed to allocate packet for stream %s", writer->stream_name);
+        return -1;
+    }
+
     if (av_packet_ref(out_pkt_ptr, pkt) < 0) {
         log_error("Failed to reference packet for stream %s", writer->stream_name);
-        av_packet_free(&out_pkt_ptr);
+        packet_pool_put_packet(writer->packet_pool, &out_pkt_ptr);
         return -1;
     }
 
     // Set up cleanup for error cases
     int result = -1;
 
-    //  CRITICAL FIX: More robust bitstream filtering for H.264 in HLS
-    // This is essential to prevent the "h264 bitstream malformed, no startcode found" error
-    // and to avoid segmentation faults during shutdown
-    if (input_stream->codecpar->codec_id == AV_CODEC_ID_H264) {
-        // Use a simpler and more reliable approach for H.264 bitstream conversion
-        // Instead of creating a new filter for each packet, we'll manually add the start code
-
-        // Check if the packet already has start codes (Annex B format)
-        bool has_start_code = false;
-        if (out_pkt_ptr->size >= 4) {
-            has_start_code = (out_pkt_ptr->data[0] == 0x00 &&
-                             out_pkt_ptr->data[1] == 0x00 &&
-                             out_pkt_ptr->data[2] == 0x00 &&
-                             out_pkt_ptr->data[3] == 0x01);
-        }
-
-        if (!has_start_code) {
-    // Create a new packet with space for the start code
-    AVPacket *new_pkt_ptr = av_packet_alloc();
-    if (!new_pkt_ptr) {
-        log_error("Failed to allocate new packet for H.264 conversion for stream %s",
-                 writer->stream_name);
-        av_packet_free(&out_pkt_ptr);
-        return -1;
+    // Length-prefixed input is converted by a filter set up once per codec parameters;
+    // Annex B input, which is what RTSP delivers, passes through without being touched.
+    // fMP4 segments are length-prefixed, so the filter is never set up for them
+    if (writer->segment_format != HLS_SEGMENT_FMP4) {
+        annexb_filter_configure(&writer->annexb_filter, input_stream->codecpar, input_stream->time_base);
     }
-
-    // Allocate a new buffer with space for the start code
-    if (av_new_packet(new_pkt_ptr, out_pkt_ptr->size + 4) < 0) {
-        log_error("Failed to allocate new packet for H.264 conversion for stream %s",
-                 writer->stream_name);
-        av_packet_free(&new_pkt_ptr);
-        av_packet_free(&out_pkt_ptr);
+    if (annexb_filter_apply(&writer->annexb_filter, out_pkt_ptr) < 0) {
+        log_warn("Failed to convert %s packet to Annex B for stream %s",
+                avcodec_get_name(input_stream->codecpar->codec_id), writer->stream_name);
+        packet_pool_put_packet(writer->packet_pool, &out_pkt_ptr);
         return -1;
     }
 
-    // Add start code
-    new_pkt_ptr->data[0] = 0x00;
-    new_pkt_ptr->data[1] = 0x00;
-    new_pkt_ptr->data[2] = 0x00;
-    new_pkt_ptr->data[3] = 0x01;
-
-    // Copy the packet data
-    memcpy(new_pkt_ptr->data + 4, out_pkt_ptr->data, out_pkt_ptr->size);
-
-    // Copy other packet properties
-    new_pkt_ptr->pts = out_pkt_ptr->pts;
-    new_pkt_ptr->dts = out_pkt_ptr->dts;
-    new_pkt_ptr->flags = out_pkt_ptr->flags;
-    new_pkt_ptr->stream_index = out_pkt_ptr->stream_index;
-    new_pkt_ptr->duration = out_pkt_ptr->duration;
-    new_pkt_ptr->pos = out_pkt_ptr->pos;
-
-    // Unref the original packet
-    av_packet_free(&out_pkt_ptr);
-
-    // Use the new packet as our output packet
-    out_pkt_ptr = new_pkt_ptr;
-    new_pkt_ptr = NULL; // Prevent double-free
-
-            log_debug("Added H.264 start code for stream %s", writer->stream_name);
-        }
-    } else {
-        log_debug("Using original packet for non-H264 stream %s", writer->stream_name);
-    }
-
     // Initialize DTS tracker if needed
     stream_dts_info_t *dts_tracker = &writer->dts_tracker;
     if (!dts_tracker->initialized) {
@@ -765,7 +844,7 @@ int hls_writer_write_packet(hls_writer_t *writer, const AVPacket *pkt, const AVS
     // Validate writer context before rescaling
     if (!writer->output_ctx || !writer->output_ctx->streams || !writer->output_ctx->streams[0]) {
         log_warn("hls_writer_write_packet: Writer context invalid for stream %s", writer->stream_name);
-        av_packet_free(&out_pkt_ptr);
+        packet_pool_put_packet(writer->packet_pool, &out_pkt_ptr);
         return -1;
     }
 
@@ -796,10 +875,21 @@ int hls_writer_write_packet(hls_writer_t *writer, const AVPacket *pkt, const AVS
                  writer->stream_name, (long long)out_pkt_ptr->pts, (long long)out_pkt_ptr->dts, out_pkt_ptr->size);
     }
 
+    // Segment boundaries are derived from these when the muxer closes a segment
+    writer->last_pts = out_pkt_ptr->pts;
+    if (writer->segment_start_pts == AV_NOPTS_VALUE) {
+        writer->segment_start_pts = out_pkt_ptr->pts;
+    }
+
+    // The packager takes its own reference, the muxer below consumes the packet
+    if (writer->ll_packager) {
+        hls_ll_packager_write_packet(writer->ll_packager, out_pkt_ptr, writer->output_ctx->streams[0]->time_base);
+    }
+
     result = av_interleaved_write_frame(writer->output_ctx, out_pkt_ptr);
 
     // Clean up packet
-    av_packet_free(&out_pkt_ptr);
+    packet_pool_put_packet(writer->packet_pool, &out_pkt_ptr);
 
     // Handle write errors
     if (result < 0) {
@@ -1184,14 +1274,24 @@ void hls_writer_close(hls_writer_t *writer) {
         log_info("Successfully freed format context for HLS writer for stream %s", stream_name);
     }
 
+    // Parts are cut from the packets written above, so the packager has nothing left to publish
+    if (writer->ll_packager) {
+        hls_ll_packager_destroy(writer->ll_packager);
+        writer->ll_packager = NULL;
+    }
+
+    // The trailer closed the last segment; nothing is written to the index after this
+    hls_segment_index_close(stream_name, writer);
+
+    // Likewise the recording, which ends with that segment
+    hls_recording_close(writer->recording);
+    writer->recording = NULL;
+
     // Free bitstream filter context if it exists
-    if (writer->bsf_ctx) {
+    if (writer->annexb_filter.ctx) {
         log_info("Freeing bitstream filter context for HLS writer for stream %s", stream_name);
-        AVBSFContext *bsf_to_free = writer->bsf_ctx;
-        writer->bsf_ctx = NULL;
-        av_bsf_free(&bsf_to_free);
-        log_info("Successfully freed bitstream filter context for HLS writer for stream %s", stream_name);
     }
+    annexb_filter_free(&writer->annexb_filter);
 
     // Destroy mutex with proper error handling
     if (mutex_result == 0) { // Only destroy if we successfully acquired it
@@ -1244,10 +1344,9 @@ void hls_writer_close(hls_writer_t *writer) {
     }
 
     // Free bitstream filter context if it exists
-    if (writer->bsf_ctx) {
+    if (writer->annexb_filter.ctx) {
         log_warn("Bitstream filter context still exists during final cleanup for stream %s", stream_name);
-        av_bsf_free(&writer->bsf_ctx);
-        writer->bsf_ctx = NULL;
+        annexb_filter_free(&writer->annexb_filter);
     }
 
     // Reset DTS tracker
@@ -0,0 +1,325 @@
+/**
+ * Hardware-accelerated Decoding
+ *
+ * Resolves the configured hardware backend once and shares a single device
+ * context between all decoders that use it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <libavcodec/avcodec.h>
+#include <libavutil/hwcontext.h>
+#include <libavutil/pixdesc.h>
+
+#include "core/logger.h"
+#include "core/config.h"
+#include "video/hw_decode.h"
+
+/**
+ * Known hardware backends, in auto-probe order
+ */
+typedef struct {
+    const char *name;
+    enum AVHWDeviceType device_type;    // AV_HWDEVICE_TYPE_NONE for wrapper decoders
+    const char *decoder_suffix;         // Wrapper decoder suffix (e.g. "rkmpp" for h264_rkmpp)
+    const char *probe_path;             // Device node that must exist for auto-probing
+    bool auto_probe;                    // Whether the backend is tried when hw_accel_device is "auto"
+} hw_backend_t;
+
+static const hw_backend_t hw_backends[] = {
+    { "vaapi",   AV_HWDEVICE_TYPE_VAAPI, NULL,      NULL,               true  },
+    { "cuda",    AV_HWDEVICE_TYPE_CUDA,  NULL,      NULL,               true  },
+    { "qsv",     AV_HWDEVICE_TYPE_QSV,   NULL,      NULL,               true  },
+    { "rkmpp",   AV_HWDEVICE_TYPE_NONE,  "rkmpp",   "/dev/mpp_service", true  },
+    // V4L2 M2M decoders are compiled into most ARM builds whether or not the
+    // board has a codec, so they are only used when configured explicitly
+    { "v4l2m2m", AV_HWDEVICE_TYPE_NONE,  "v4l2m2m", NULL,               false },
+};
+
+#define HW_BACKEND_COUNT (sizeof(hw_backends) / sizeof(hw_backends[0]))
+
+static pthread_mutex_t hw_mutex = PTHREAD_MUTEX_INITIALIZER;
+static bool hw_resolved = false;
+static const hw_backend_t *hw_backend = NULL;
+static AVBufferRef *hw_device_ref = NULL;
+
+/**
+ * Find a backend by name (accepts "nvdec" for CUDA)
+ */
+static const hw_backend_t *find_backend(const char *name) {
+    if (strcmp(name, "nvdec") == 0) {
+        name = "cuda";
+    }
+
+    for (size_t i = 0; i < HW_BACKEND_COUNT; i++) {
+        if (strcmp(hw_backends[i].name, name) == 0) {
+            return &hw_backends[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Check whether a wrapper decoder backend is available for H.264
+ */
+static bool wrapper_available(const hw_backend_t *backend) {
+    char decoder_name[64];
+    snprintf(decoder_name, sizeof(decoder_name), "h264_%s", backend->decoder_suffix);
+    return avcodec_find_decoder_by_name(decoder_name) != NULL;
+}
+
+/**
+ * Try to make a backend the active one
+ * Must be called with hw_mutex held.
+ */
+static bool try_backend(const hw_backend_t *backend, const char *device, bool probing) {
+    if (probing && backend->probe_path && access(backend->probe_path, F_OK) != 0) {
+        return false;
+    }
+
+    if (backend->device_type == AV_HWDEVICE_TYPE_NONE) {
+        if (!wrapper_available(backend)) {
+            if (!probing) {
+                log_warn("Hardware decoding backend %s is not available in this FFmpeg build", backend->name);
+            }
+            return false;
+        }
+        hw_backend = backend;
+        return true;
+    }
+
+    AVBufferRef *device_ref = NULL;
+    int ret = av_hwdevice_ctx_create(&device_ref, backend->device_type,
+                                     (device && device[0] != '\0') ? device : NULL, NULL, 0);
+    if (ret < 0) {
+        if (!probing) {
+            char err_buf[AV_ERROR_MAX_STRING_SIZE] = {0};
+            av_strerror(ret, err_buf, sizeof(err_buf));
+            log_warn("Failed to create %s hardware device%s%s: %s", backend->name,
+                    device && device[0] ? " " : "", device ? device : "", err_buf);
+        }
+        return false;
+    }
+
+    hw_backend = backend;
+    hw_device_ref = device_ref;
+    return true;
+}
+
+/**
+ * Resolve the hardware backend from the configuration
+ * Must be called with hw_mutex held.
+ */
+static void resolve_backend(void) {
+    if (hw_resolved) {
+        return;
+    }
+    hw_resolved = true;
+
+    if (!g_config.hw_accel_enabled) {
+        log_info("Hardware decoding disabled, using software decoding");
+        return;
+    }
+
+    // Split "backend:device"
+    char name[sizeof(g_config.hw_accel_device)];
+    strncpy(name, g_config.hw_accel_device, sizeof(name) - 1);
+    name[sizeof(name) - 1] = '\0';
+
+    char *device = strchr(name, ':');
+    if (device) {
+        *device++ = '\0';
+    }
+
+    if (name[0] == '\0' || strcmp(name, "auto") == 0) {
+        for (size_t i = 0; i < HW_BACKEND_COUNT && !hw_backend; i++) {
+            if (hw_backends[i].auto_probe) {
+                try_backend(&hw_backends[i], NULL, true);
+            }
+        }
+    } else {
+        const hw_backend_t *backend = find_backend(name);
+        if (!backend) {
+            log_warn("Unknown hardware decoding backend: %s", name);
+        } else {
+            try_backend(backend, device, false);
+        }
+    }
+
+    if (hw_backend) {
+        log_info("Using %s hardware decoding", hw_backend->name);
+    } else {
+        log_info("No hardware decoding backend available, using software decoding");
+    }
+}
+
+/**
+ * Find the decoder to use for a codec
+ */
+const AVCodec *hw_decode_find_decoder(enum AVCodecID codec_id) {
+    pthread_mutex_lock(&hw_mutex);
+    resolve_backend();
+    const hw_backend_t *backend = hw_backend;
+    pthread_mutex_unlock(&hw_mutex);
+
+    if (backend && backend->decoder_suffix) {
+        char decoder_name[64];
+        snprintf(decoder_name, sizeof(decoder_name), "%s_%s", avcodec_get_name(codec_id), backend->decoder_suffix);
+        const AVCodec *codec = avcodec_find_decoder_by_name(decoder_name);
+        if (codec) {
+            return codec;
+        }
+        log_debug("No %s decoder, falling back to software decoding", decoder_name);
+    }
+
+    return avcodec_find_decoder(codec_id);
+}
+
+/**
+ * Get the surface format a decoder produces on a device type
+ *
+ * @return Pixel format or AV_PIX_FMT_NONE if the decoder cannot use the device
+ */
+static enum AVPixelFormat device_pix_fmt(const AVCodec *codec, enum AVHWDeviceType device_type) {
+    for (int i = 0;; i++) {
+        const AVCodecHWConfig *config = avcodec_get_hw_config(codec, i);
+        if (!config) {
+            return AV_PIX_FMT_NONE;
+        }
+        if ((config->methods & AV_CODEC_HW_CONFIG_METHOD_HW_DEVICE_CTX) &&
+            config->device_type == device_type) {
+            return config->pix_fmt;
+        }
+    }
+}
+
+/**
+ * Pick the hardware surface format of the context's device
+ */
+static enum AVPixelFormat get_hw_format(AVCodecContext *ctx, const enum AVPixelFormat *formats) {
+    enum AVPixelFormat hw_format = AV_PIX_FMT_NONE;
+
+    if (ctx->hw_device_ctx) {
+        const AVHWDeviceContext *device = (const AVHWDeviceContext *)ctx->hw_device_ctx->data;
+        hw_format = device_pix_fmt(ctx->codec, device->type);
+    }
+
+    for (const enum AVPixelFormat *p = formats; *p != AV_PIX_FMT_NONE; p++) {
+        if (*p == hw_format) {
+            return *p;
+        }
+    }
+
+    // The stream cannot be decoded on this device (e.g. unsupported profile)
+    for (const enum AVPixelFormat *p = formats; *p != AV_PIX_FMT_NONE; p++) {
+        const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(*p);
+        if (desc && !(desc->flags & AV_PIX_FMT_FLAG_HWACCEL)) {
+            log_warn("Hardware decoding not supported for this stream, using software decoding");
+            return *p;
+        }
+    }
+
+    return AV_PIX_FMT_NONE;
+}
+
+/**
+ * Attach the selected hwaccel device to a decoder context
+ */
+int hw_decode_setup(AVCodecContext *codec_ctx) {
+    if (!codec_ctx || !codec_ctx->codec) {
+        return 1;
+    }
+
+    pthread_mutex_lock(&hw_mutex);
+    resolve_backend();
+
+    if (!hw_device_ref) {
+        pthread_mutex_unlock(&hw_mutex);
+        // Wrapper decoders handle the hardware themselves
+        return (hw_backend && hw_backend->decoder_suffix &&
+                strstr(codec_ctx->codec->name, hw_backend->decoder_suffix)) ? 0 : 1;
+    }
+
+    const AVHWDeviceContext *device = (const AVHWDeviceContext *)hw_device_ref->data;
+    if (device_pix_fmt(codec_ctx->codec, device->type) == AV_PIX_FMT_NONE) {
+        pthread_mutex_unlock(&hw_mutex);
+        log_debug("Decoder %s does not support %s, using software decoding",
+                 codec_ctx->codec->name, hw_backend->name);
+        return 1;
+    }
+
+    codec_ctx->hw_device_ctx = av_buffer_ref(hw_device_ref);
+    pthread_mutex_unlock(&hw_mutex);
+
+    if (!codec_ctx->hw_device_ctx) {
+        return 1;
+    }
+
+    codec_ctx->get_format = get_hw_format;
+    return 0;
+}
+
+/**
+ * Get a frame whose pixels are in system memory
+ */
+const AVFrame *hw_decode_get_sw_frame(const AVFrame *frame, AVFrame *sw_frame) {
+    if (!frame) {
+        return NULL;
+    }
+
+    if (!frame->hw_frames_ctx) {
+        return frame;
+    }
+
+    if (!sw_frame) {
+        return NULL;
+    }
+
+    av_frame_unref(sw_frame);
+    int ret = av_hwframe_transfer_data(sw_frame, frame, 0);
+    if (ret < 0) {
+        char err_buf[AV_ERROR_MAX_STRING_SIZE] = {0};
+        av_strerror(ret, err_buf, sizeof(err_buf));
+        log_error("Failed to download hardware frame: %s", err_buf);
+        return NULL;
+    }
+
+    av_frame_copy_props(sw_frame, frame);
+    return sw_frame;
+}
+
+/**
+ * Get the name of the selected backend
+ */
+const char *hw_decode_backend_name(void) {
+    pthread_mutex_lock(&hw_mutex);
+    const char *name = hw_backend ? hw_backend->name : "software";
+    pthread_mutex_unlock(&hw_mutex);
+    return name;
+}
+
+/**
+ * Get a reference to the shared hwaccel device, for hardware encoders
+ */
+AVBufferRef *hw_decode_device_ref(void) {
+    pthread_mutex_lock(&hw_mutex);
+    resolve_backend();
+    AVBufferRef *ref = hw_device_ref ? av_buffer_ref(hw_device_ref) : NULL;
+    pthread_mutex_unlock(&hw_mutex);
+    return ref;
+}
+
+/**
+ * Release the shared hardware device
+ */
+void hw_decode_cleanup(void) {
+    pthread_mutex_lock(&hw_mutex);
+    av_buffer_unref(&hw_device_ref);
+    hw_backend = NULL;
+    hw_resolved = false;
+    pthread_mutex_unlock(&hw_mutex);
+}
@@ -0,0 +1,248 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <libavcodec/avcodec.h>
+#include <libavutil/frame.h>
+#include <libavutil/imgutils.h>
+#include <libswscale/swscale.h>
+
+#include "core/logger.h"
+#include "video/jpeg_encoder.h"
+
+struct jpeg_encoder {
+    AVCodecContext *codec_ctx;   // MJPEG encoder for the current size
+    struct SwsContext *sws_ctx;  // Source pixels to YUVJ420P, rebuilt when the source changes
+    AVFrame *frame;              // YUVJ420P frame handed to the encoder
+    AVPacket *packet;            // Last encoded image
+    int width;                   // Size of the encoded image
+    int height;
+};
+
+// Encoders of the threads that asked for one, freed when the thread exits
+static pthread_key_t thread_encoder_key;
+static pthread_once_t thread_encoder_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Map a JPEG quality (1-100) to an MJPEG quantizer scale (2-31)
+ * 75 lands on the scale 4 ffmpeg users know as good quality; below 50 the
+ * quantizer grows quickly, like the quantization tables of libjpeg do.
+ */
+static int quality_to_qscale(int quality) {
+    if (quality < 1) {
+        quality = 1;
+    } else if (quality > 100) {
+        quality = 100;
+    }
+
+    if (quality >= 50) {
+        return 2 + (100 - quality) / 10;
+    }
+    return 7 + (50 - quality) * 24 / 49;
+}
+
+/**
+ * Free the codec, scaler and frame of the current size
+ */
+static void close_encoder(jpeg_encoder_t *encoder) {
+    if (encoder->codec_ctx) {
+        avcodec_free_context(&encoder->codec_ctx);
+    }
+    if (encoder->sws_ctx) {
+        sws_freeContext(encoder->sws_ctx);
+        encoder->sws_ctx = NULL;
+    }
+    if (encoder->frame) {
+        av_frame_free(&encoder->frame);
+    }
+    encoder->width = 0;
+    encoder->height = 0;
+}
+
+/**
+ * Set the encoder up for images of a new size
+ */
+static int open_encoder(jpeg_encoder_t *encoder, int width, int height) {
+    close_encoder(encoder);
+
+    const AVCodec *codec = avcodec_find_encoder(AV_CODEC_ID_MJPEG);
+    if (!codec) {
+        log_error("MJPEG encoder not available in this FFmpeg build");
+        return -1;
+    }
+
+    encoder->codec_ctx = avcodec_alloc_context3(codec);
+    if (!encoder->codec_ctx) {
+        log_error("Failed to allocate MJPEG encoder context");
+        return -1;
+    }
+
+    encoder->codec_ctx->width = width;
+    encoder->codec_ctx->height = height;
+    encoder->codec_ctx->pix_fmt = AV_PIX_FMT_YUVJ420P;
+    encoder->codec_ctx->color_range = AVCOL_RANGE_JPEG;
+    encoder->codec_ctx->time_base = (AVRational){1, 25};
+    encoder->codec_ctx->flags |= AV_CODEC_FLAG_QSCALE;
+
+    int ret = avcodec_open2(encoder->codec_ctx, codec, NULL);
+    if (ret < 0) {
+        char error_buf[AV_ERROR_MAX_STRING_SIZE] = {0};
+        av_strerror(ret, error_buf, sizeof(error_buf));
+        log_error("Failed to open MJPEG encoder for %dx%d: %s", width, height, error_buf);
+        close_encoder(encoder);
+        return -1;
+    }
+
+    encoder->frame = av_frame_alloc();
+    if (!encoder->frame) {
+        log_error("Failed to allocate JPEG conversion for %dx%d", width, height);
+        close_encoder(encoder);
+        return -1;
+    }
+
+    encoder->frame->format = AV_PIX_FMT_YUVJ420P;
+    encoder->frame->width = width;
+    encoder->frame->height = height;
+    if (av_frame_get_buffer(encoder->frame, 0) < 0) {
+        log_error("Failed to allocate JPEG frame for %dx%d", width, height);
+        close_encoder(encoder);
+        return -1;
+    }
+
+    encoder->width = width;
+    encoder->height = height;
+    return 0;
+}
+
+jpeg_encoder_t *jpeg_encoder_create(void) {
+    jpeg_encoder_t *encoder = calloc(1, sizeof(jpeg_encoder_t));
+    if (!encoder) {
+        return NULL;
+    }
+
+    encoder->packet = av_packet_alloc();
+    if (!encoder->packet) {
+        free(encoder);
+        return NULL;
+    }
+    return encoder;
+}
+
+void jpeg_encoder_destroy(jpeg_encoder_t *encoder) {
+    if (!encoder) {
+        return;
+    }
+
+    close_encoder(encoder);
+    av_packet_free(&encoder->packet);
+    free(encoder);
+}
+
+static void destroy_thread_encoder(void *encoder) {
+    jpeg_encoder_destroy(encoder);
+}
+
+static void create_thread_encoder_key(void) {
+    pthread_key_create(&thread_encoder_key, destroy_thread_encoder);
+}
+
+jpeg_encoder_t *jpeg_encoder_for_thread(void) {
+    pthread_once(&thread_encoder_once, create_thread_encoder_key);
+
+    jpeg_encoder_t *encoder = pthread_getspecific(thread_encoder_key);
+    if (!encoder) {
+        encoder = jpeg_encoder_create();
+        if (encoder) {
+            pthread_setspecific(thread_encoder_key, encoder);
+        }
+    }
+    return encoder;
+}
+
+/**
+ * Convert source pixels to YUVJ420P at the image size and encode them
+ */
+static int encode_scaled(jpeg_encoder_t *encoder, const uint8_t *const src_data[], const int src_linesize[],
+                         int src_width, int src_height, enum AVPixelFormat src_format,
+                         int width, int height, int quality, const uint8_t **jpeg, size_t *jpeg_size) {
+    if (encoder->width != width || encoder->height != height) {
+        if (open_encoder(encoder, width, height) != 0) {
+            return -1;
+        }
+    }
+
+    // Returns the current scaler unchanged while the source stays the same
+    encoder->sws_ctx = sws_getCachedContext(encoder->sws_ctx, src_width, src_height, src_format,
+                                            width, height, AV_PIX_FMT_YUVJ420P,
+                                            SWS_BILINEAR, NULL, NULL, NULL);
+    if (!encoder->sws_ctx) {
+        log_error("Failed to allocate JPEG conversion from %dx%d to %dx%d",
+                 src_width, src_height, width, height);
+        return -1;
+    }
+
+    // The encoder may still hold a reference to the previous frame's buffers
+    if (av_frame_make_writable(encoder->frame) < 0) {
+        log_error("Failed to make JPEG frame writable");
+        return -1;
+    }
+
+    sws_scale(encoder->sws_ctx, src_data, src_linesize, 0, src_height,
+              encoder->frame->data, encoder->frame->linesize);
+
+    encoder->frame->quality = FF_QP2LAMBDA * quality_to_qscale(quality);
+    encoder->frame->pts++;
+
+    av_packet_unref(encoder->packet);
+    int ret = avcodec_send_frame(encoder->codec_ctx, encoder->frame);
+    if (ret >= 0) {
+        ret = avcodec_receive_packet(encoder->codec_ctx, encoder->packet);
+    }
+    if (ret < 0) {
+        char error_buf[AV_ERROR_MAX_STRING_SIZE] = {0};
+        av_strerror(ret, error_buf, sizeof(error_buf));
+        log_error("Failed to encode %dx%d frame to JPEG: %s", width, height, error_buf);
+        return -1;
+    }
+
+    *jpeg = encoder->packet->data;
+    *jpeg_size = (size_t)encoder->packet->size;
+    return 0;
+}
+
+int jpeg_encoder_encode(jpeg_encoder_t *encoder, const uint8_t *data, int width, int height,
+                        int channels, int quality, const uint8_t **jpeg, size_t *jpeg_size) {
+    if (!encoder || !data || !jpeg || !jpeg_size || width <= 0 || height <= 0 ||
+        (channels != 1 && channels != 3 && channels != 4)) {
+        return -1;
+    }
+
+    enum AVPixelFormat src_format = channels == 1 ? AV_PIX_FMT_GRAY8 :
+                                    channels == 3 ? AV_PIX_FMT_RGB24 : AV_PIX_FMT_RGBA;
+    const uint8_t *src_data[1] = { data };
+    int src_linesize[1] = { width * channels };
+    return encode_scaled(encoder, src_data, src_linesize, width, height, src_format,
+                         width, height, quality, jpeg, jpeg_size);
+}
+
+int jpeg_encoder_encode_frame(jpeg_encoder_t *encoder, const AVFrame *frame, int width, int quality,
+                              const uint8_t **jpeg, size_t *jpeg_size) {
+    if (!encoder || !frame || !jpeg || !jpeg_size || frame->width <= 0 || frame->height <= 0 ||
+        frame->hw_frames_ctx) {
+        return -1;
+    }
+
+    // Scale down only, keeping the aspect ratio; 4:2:0 needs even dimensions
+    if (width <= 0 || width > frame->width) {
+        width = frame->width;
+    }
+    int height = (int)((int64_t)frame->height * width / frame->width);
+    width = (width + 1) & ~1;
+    height = height < 2 ? 2 : (height + 1) & ~1;
+
+    return encode_scaled(encoder, (const uint8_t *const *)frame->data, frame->linesize,
+                         frame->width, frame->height, (enum AVPixelFormat)frame->format,
+                         width, height, quality, jpeg, jpeg_size);
+}
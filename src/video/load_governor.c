@@ -0,0 +1,301 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "core/logger.h"
+#include "core/config.h"
+#include "video/load_governor.h"
+#include "video/thread_utils.h"
+
+// Seconds between load samples
+#define LOAD_SAMPLE_SECONDS 5
+
+// Consecutive overloaded samples before the next step is shed
+#define LOAD_ESCALATE_SAMPLES 3
+
+// Consecutive quiet samples before a step is undone
+#define LOAD_RELAX_SAMPLES 6
+
+// CPU time counters from /proc/stat
+typedef struct {
+    unsigned long long busy;
+    unsigned long long total;
+} cpu_times_t;
+
+static pthread_t governor_thread;
+static bool governor_running = false;
+static pthread_mutex_t governor_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t governor_cond = PTHREAD_COND_INITIALIZER;   // Signaled to stop the thread
+
+static load_governor_status_t current_status;
+static load_shed_event_t events[LOAD_SHED_MAX_EVENTS];
+static int event_count = 0;
+static int event_next = 0;
+
+const char *load_shed_level_name(load_shed_level_t level) {
+    switch (level) {
+        case LOAD_SHED_NONE:
+            return "none";
+        case LOAD_SHED_REDUCE_RATE:
+            return "reduce_rate";
+        case LOAD_SHED_KEY_FRAMES:
+            return "key_frames";
+        case LOAD_SHED_PAUSE_LOW_PRIORITY:
+            return "pause_low_priority";
+    }
+    return "unknown";
+}
+
+static bool read_cpu_times(cpu_times_t *times) {
+    FILE *fp = fopen("/proc/stat", "r");
+    if (!fp) {
+        return false;
+    }
+
+    unsigned long long user = 0, nice = 0, system = 0, idle = 0;
+    unsigned long long iowait = 0, irq = 0, softirq = 0, steal = 0;
+    int fields = fscanf(fp, "cpu %llu %llu %llu %llu %llu %llu %llu %llu",
+                        &user, &nice, &system, &idle, &iowait, &irq, &softirq, &steal);
+    fclose(fp);
+    if (fields < 4) {
+        return false;
+    }
+
+    times->busy = user + nice + system + irq + softirq + steal;
+    times->total = times->busy + idle + iowait;
+    return true;
+}
+
+/**
+ * Percent of system memory in use, counting reclaimable cache as free
+ */
+static double read_memory_usage(void) {
+    FILE *fp = fopen("/proc/meminfo", "r");
+    if (!fp) {
+        return 0.0;
+    }
+
+    unsigned long long total = 0, available = 0;
+    char line[128];
+    while (fgets(line, sizeof(line), fp)) {
+        if (strncmp(line, "MemTotal:", 9) == 0) {
+            sscanf(line + 9, "%llu", &total);
+        } else if (strncmp(line, "MemAvailable:", 13) == 0) {
+            sscanf(line + 13, "%llu", &available);
+        }
+    }
+    fclose(fp);
+
+    if (total == 0 || available > total) {
+        return 0.0;
+    }
+    return (double)(total - available) * 100.0 / (double)total;
+}
+
+static unsigned long long read_process_memory(void) {
+    FILE *fp = fopen("/proc/self/status", "r");
+    if (!fp) {
+        return 0;
+    }
+
+    unsigned long long rss_kb = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), fp)) {
+        if (strncmp(line, "VmRSS:", 6) == 0) {
+            sscanf(line + 6, "%llu", &rss_kb);
+            break;
+        }
+    }
+    fclose(fp);
+    return rss_kb * 1024;
+}
+
+/**
+ * Move to a new level and record the event
+ * Must be called with the governor mutex held.
+ */
+static void set_level_locked(load_shed_level_t level) {
+    load_shed_event_t *event = &events[event_next];
+    event->time = time(NULL);
+    event->level = level;
+    event->previous = current_status.level;
+    event->cpu_usage = current_status.cpu_usage;
+    event->memory_usage = current_status.memory_usage;
+    event_next = (event_next + 1) % LOAD_SHED_MAX_EVENTS;
+    if (event_count < LOAD_SHED_MAX_EVENTS) {
+        event_count++;
+    }
+
+    if (level > current_status.level) {
+        log_warn("Load shedding: CPU %.0f%%, memory %.0f%%, detection now shed to %s",
+                 current_status.cpu_usage, current_status.memory_usage, load_shed_level_name(level));
+    } else {
+        log_info("Load shedding: CPU %.0f%%, memory %.0f%%, detection back to %s",
+                 current_status.cpu_usage, current_status.memory_usage, load_shed_level_name(level));
+    }
+    current_status.level = level;
+}
+
+static void *load_governor_func(void *arg) {
+    (void)arg;
+    thread_set_identity(THREAD_CLASS_SERVICE, "governor", NULL);
+
+    cpu_times_t previous = {0, 0};
+    bool have_previous = read_cpu_times(&previous);
+    int high_samples = 0;
+    int low_samples = 0;
+
+    pthread_mutex_lock(&governor_mutex);
+    while (governor_running) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += LOAD_SAMPLE_SECONDS;
+        pthread_cond_timedwait(&governor_cond, &governor_mutex, &deadline);
+        if (!governor_running) {
+            break;
+        }
+        pthread_mutex_unlock(&governor_mutex);
+
+        // Usage over the last period, not since boot
+        double cpu_usage = 0.0;
+        cpu_times_t now;
+        bool have_now = read_cpu_times(&now);
+        if (have_now && have_previous && now.total > previous.total) {
+            cpu_usage = (double)(now.busy - previous.busy) * 100.0 / (double)(now.total - previous.total);
+        }
+        if (have_now) {
+            previous = now;
+            have_previous = true;
+        }
+        double memory_usage = read_memory_usage();
+        unsigned long long process_memory = read_process_memory();
+
+        pthread_mutex_lock(&governor_mutex);
+        current_status.cpu_usage = cpu_usage;
+        current_status.memory_usage = memory_usage;
+        current_status.process_memory = process_memory;
+
+        bool overloaded = cpu_usage >= g_config.load_shed_cpu_high ||
+                          memory_usage >= g_config.load_shed_memory_high;
+        bool relaxed = cpu_usage < g_config.load_shed_cpu_low &&
+                       memory_usage < g_config.load_shed_memory_low;
+
+        // Between the marks the level holds, so it does not flap
+        if (overloaded) {
+            low_samples = 0;
+            if (++high_samples >= LOAD_ESCALATE_SAMPLES &&
+                current_status.level < LOAD_SHED_PAUSE_LOW_PRIORITY) {
+                set_level_locked(current_status.level + 1);
+                high_samples = 0;
+            }
+        } else if (relaxed) {
+            high_samples = 0;
+            if (++low_samples >= LOAD_RELAX_SAMPLES && current_status.level > LOAD_SHED_NONE) {
+                set_level_locked(current_status.level - 1);
+                low_samples = 0;
+            }
+        } else {
+            high_samples = 0;
+            low_samples = 0;
+        }
+    }
+    pthread_mutex_unlock(&governor_mutex);
+
+    return NULL;
+}
+
+int load_governor_init(void) {
+    if (!g_config.load_shedding_enabled) {
+        log_info("Load shedding disabled");
+        return 0;
+    }
+
+    pthread_mutex_lock(&governor_mutex);
+    if (governor_running) {
+        pthread_mutex_unlock(&governor_mutex);
+        return 0;
+    }
+
+    memset(&current_status, 0, sizeof(current_status));
+    current_status.enabled = true;
+    event_count = 0;
+    event_next = 0;
+    governor_running = true;
+
+    if (pthread_create(&governor_thread, NULL, load_governor_func, NULL) != 0) {
+        log_error("Failed to start load governor thread");
+        governor_running = false;
+        current_status.enabled = false;
+        pthread_mutex_unlock(&governor_mutex);
+        return -1;
+    }
+    pthread_mutex_unlock(&governor_mutex);
+
+    log_info("Load shedding enabled (CPU %d%%/%d%%, memory %d%%/%d%%, pausing streams below priority %d)",
+             g_config.load_shed_cpu_high, g_config.load_shed_cpu_low,
+             g_config.load_shed_memory_high, g_config.load_shed_memory_low,
+             g_config.load_shed_pause_priority);
+    return 0;
+}
+
+void load_governor_shutdown(void) {
+    pthread_mutex_lock(&governor_mutex);
+    if (!governor_running) {
+        pthread_mutex_unlock(&governor_mutex);
+        return;
+    }
+    governor_running = false;
+    pthread_cond_signal(&governor_cond);
+    pthread_mutex_unlock(&governor_mutex);
+
+    pthread_join(governor_thread, NULL);
+
+    pthread_mutex_lock(&governor_mutex);
+    current_status.level = LOAD_SHED_NONE;
+    current_status.enabled = false;
+    pthread_mutex_unlock(&governor_mutex);
+
+    log_info("Load governor stopped");
+}
+
+load_shed_level_t load_governor_level(void) {
+    pthread_mutex_lock(&governor_mutex);
+    load_shed_level_t level = current_status.level;
+    pthread_mutex_unlock(&governor_mutex);
+    return level;
+}
+
+bool load_governor_detection_paused(int priority) {
+    return priority < g_config.load_shed_pause_priority &&
+           load_governor_level() >= LOAD_SHED_PAUSE_LOW_PRIORITY;
+}
+
+void load_governor_get_status(load_governor_status_t *status) {
+    if (!status) {
+        return;
+    }
+
+    pthread_mutex_lock(&governor_mutex);
+    *status = current_status;
+    pthread_mutex_unlock(&governor_mutex);
+}
+
+int load_governor_get_events(load_shed_event_t *out, int max_events) {
+    if (!out || max_events <= 0) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&governor_mutex);
+    int count = event_count < max_events ? event_count : max_events;
+    for (int i = 0; i < count; i++) {
+        int index = (event_next - 1 - i + LOAD_SHED_MAX_EVENTS) % LOAD_SHED_MAX_EVENTS;
+        out[i] = events[index];
+    }
+    pthread_mutex_unlock(&governor_mutex);
+    return count;
+}
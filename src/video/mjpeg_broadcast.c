@@ -0,0 +1,243 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+
+#include <libavutil/buffer.h>
+
+#include "core/logger.h"
+#include "core/config.h"
+#include "core/metrics.h"
+#include "video/mjpeg_broadcast.h"
+#include "video/snapshot_cache.h"
+#include "video/thread_utils.h"
+
+// Stream broadcast to its viewers
+typedef struct {
+    char stream_name[MAX_STREAM_NAME];
+    int viewers;                    // 0 while the channel is free
+    AVBufferRef *jpeg;              // Newest frame, NULL until the first
+    atomic_uint_fast64_t seq;       // Frames published, read by viewers without the mutex
+} mjpeg_channel_t;
+
+static mjpeg_channel_t channels[MAX_STREAMS];
+static int total_viewers = 0;
+static pthread_t broadcast_thread;
+static bool broadcast_running = false;
+static pthread_mutex_t broadcast_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t broadcast_cond = PTHREAD_COND_INITIALIZER;   // Signaled on the first viewer and to stop
+
+static metric_t viewers_metric;
+static metric_t published_metric;
+
+/**
+ * Take the newest frame of a channel from the snapshot cache and publish it if it is new
+ */
+static void publish_frame(int index, const char *stream_name, int interval_ms) {
+    AVBufferRef *jpeg = NULL;
+    if (snapshot_cache_get_jpeg_every(stream_name, g_config.mjpeg_width, MJPEG_BROADCAST_QUALITY,
+                                      interval_ms, &jpeg, NULL) != 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&broadcast_mutex);
+    mjpeg_channel_t *channel = &channels[index];
+    // The cache hands out the same buffer until it encodes the next frame
+    if (channel->viewers > 0 && strcmp(channel->stream_name, stream_name) == 0 &&
+        (!channel->jpeg || channel->jpeg->data != jpeg->data)) {
+        AVBufferRef *old = channel->jpeg;
+        channel->jpeg = jpeg;
+        jpeg = old;
+        atomic_fetch_add(&channel->seq, 1);
+        metrics_add(published_metric, 1);
+    }
+    pthread_mutex_unlock(&broadcast_mutex);
+
+    av_buffer_unref(&jpeg);
+}
+
+static void *mjpeg_broadcast_func(void *arg) {
+    (void)arg;
+    thread_set_identity(THREAD_CLASS_SERVICE, "mjpeg", NULL);
+
+    int interval_ms = 1000 / g_config.mjpeg_fps;
+    char names[MAX_STREAMS][MAX_STREAM_NAME];
+
+    pthread_mutex_lock(&broadcast_mutex);
+    while (broadcast_running) {
+        if (total_viewers == 0) {
+            pthread_cond_wait(&broadcast_cond, &broadcast_mutex);
+            continue;
+        }
+
+        // Encoding happens outside the mutex, so viewers can come and go meanwhile
+        for (int i = 0; i < MAX_STREAMS; i++) {
+            names[i][0] = '\0';
+            if (channels[i].viewers > 0) {
+                memcpy(names[i], channels[i].stream_name, MAX_STREAM_NAME);
+            }
+        }
+        pthread_mutex_unlock(&broadcast_mutex);
+
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += (long)interval_ms * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+            deadline.tv_nsec %= 1000000000L;
+        }
+
+        for (int i = 0; i < MAX_STREAMS; i++) {
+            if (names[i][0] != '\0') {
+                publish_frame(i, names[i], interval_ms);
+            }
+        }
+
+        pthread_mutex_lock(&broadcast_mutex);
+        if (broadcast_running) {
+            pthread_cond_timedwait(&broadcast_cond, &broadcast_mutex, &deadline);
+        }
+    }
+    pthread_mutex_unlock(&broadcast_mutex);
+
+    return NULL;
+}
+
+int mjpeg_broadcast_init(void) {
+    if (g_config.mjpeg_max_clients <= 0) {
+        log_info("Live MJPEG disabled");
+        return 0;
+    }
+
+    pthread_mutex_lock(&broadcast_mutex);
+    if (broadcast_running) {
+        pthread_mutex_unlock(&broadcast_mutex);
+        return 0;
+    }
+
+    viewers_metric = metrics_gauge("lightnvr_mjpeg_viewers",
+                                   "Connections receiving a live MJPEG stream", NULL);
+    published_metric = metrics_counter("lightnvr_mjpeg_frames_total",
+                                       "Live MJPEG frames encoded, sent and dropped",
+                                       "result", "published", NULL);
+
+    for (int i = 0; i < MAX_STREAMS; i++) {
+        av_buffer_unref(&channels[i].jpeg);
+        channels[i].viewers = 0;
+        atomic_store(&channels[i].seq, 0);
+    }
+    total_viewers = 0;
+    broadcast_running = true;
+    if (pthread_create(&broadcast_thread, NULL, mjpeg_broadcast_func, NULL) != 0) {
+        log_error("Failed to start live MJPEG thread");
+        broadcast_running = false;
+        pthread_mutex_unlock(&broadcast_mutex);
+        return -1;
+    }
+    pthread_mutex_unlock(&broadcast_mutex);
+
+    log_info("Live MJPEG enabled: %d fps, width %d, up to %d clients",
+             g_config.mjpeg_fps, g_config.mjpeg_width, g_config.mjpeg_max_clients);
+    return 0;
+}
+
+void mjpeg_broadcast_shutdown(void) {
+    pthread_mutex_lock(&broadcast_mutex);
+    if (!broadcast_running) {
+        pthread_mutex_unlock(&broadcast_mutex);
+        return;
+    }
+    broadcast_running = false;
+    pthread_cond_signal(&broadcast_cond);
+    pthread_mutex_unlock(&broadcast_mutex);
+
+    pthread_join(broadcast_thread, NULL);
+
+    // Viewers still connected find no new frames
+    pthread_mutex_lock(&broadcast_mutex);
+    for (int i = 0; i < MAX_STREAMS; i++) {
+        av_buffer_unref(&channels[i].jpeg);
+    }
+    pthread_mutex_unlock(&broadcast_mutex);
+
+    log_info("Live MJPEG stopped");
+}
+
+int mjpeg_broadcast_join(const char *stream_name) {
+    if (!stream_name) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&broadcast_mutex);
+    if (!broadcast_running || total_viewers >= g_config.mjpeg_max_clients) {
+        pthread_mutex_unlock(&broadcast_mutex);
+        return -1;
+    }
+
+    int index = -1;
+    for (int i = 0; i < MAX_STREAMS; i++) {
+        if (channels[i].viewers > 0 && strcmp(channels[i].stream_name, stream_name) == 0) {
+            index = i;
+            break;
+        }
+        if (index < 0 && channels[i].viewers == 0) {
+            index = i;
+        }
+    }
+    if (index >= 0) {
+        mjpeg_channel_t *channel = &channels[index];
+        if (channel->viewers == 0) {
+            // A free channel starts over, so viewers never take its old frame for a new one
+            snprintf(channel->stream_name, sizeof(channel->stream_name), "%s", stream_name);
+            av_buffer_unref(&channel->jpeg);
+            log_info("Live MJPEG of %s started", stream_name);
+        }
+        channel->viewers++;
+        if (total_viewers++ == 0) {
+            pthread_cond_signal(&broadcast_cond);
+        }
+        metrics_set(viewers_metric, (uint64_t)total_viewers);
+    }
+    pthread_mutex_unlock(&broadcast_mutex);
+    return index;
+}
+
+void mjpeg_broadcast_leave(int channel) {
+    if (channel < 0 || channel >= MAX_STREAMS) {
+        return;
+    }
+
+    pthread_mutex_lock(&broadcast_mutex);
+    mjpeg_channel_t *ch = &channels[channel];
+    if (ch->viewers > 0) {
+        total_viewers--;
+        if (--ch->viewers == 0) {
+            av_buffer_unref(&ch->jpeg);
+            log_info("Live MJPEG of %s stopped", ch->stream_name);
+        }
+        metrics_set(viewers_metric, (uint64_t)total_viewers);
+    }
+    pthread_mutex_unlock(&broadcast_mutex);
+}
+
+uint64_t mjpeg_broadcast_frame(int channel, uint64_t seq, AVBufferRef **jpeg) {
+    *jpeg = NULL;
+    if (channel < 0 || channel >= MAX_STREAMS || atomic_load(&channels[channel].seq) == seq) {
+        return seq;
+    }
+
+    pthread_mutex_lock(&broadcast_mutex);
+    mjpeg_channel_t *ch = &channels[channel];
+    if (ch->jpeg) {
+        *jpeg = av_buffer_ref(ch->jpeg);
+        if (*jpeg) {
+            seq = atomic_load(&ch->seq);
+        }
+    }
+    pthread_mutex_unlock(&broadcast_mutex);
+    return seq;
+}
@@ -8,6 +8,7 @@
 #include <sys/time.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <ctype.h>
 
 // Define CLOCK_MONOTONIC if not available
 #ifndef CLOCK_MONOTONIC
@@ -19,6 +20,10 @@
 #include "video/streams.h"
 #include "video/detection_result.h"
 #include "utils/memory.h"
+#include "video/motion_kernels.h"
+#include "video/stream_registry.h"
+
+#include <libavutil/motion_vector.h>
 
 #define MAX_MOTION_STREAMS MAX_STREAMS
 #define DEFAULT_SENSITIVITY 0.15f        // Lower sensitivity threshold (was 0.25)
@@ -29,9 +34,12 @@
 #define DEFAULT_NOISE_THRESHOLD 10       // Noise filtering threshold
 #define DEFAULT_USE_GRID_DETECTION true  // Use grid-based detection
 #define DEFAULT_GRID_SIZE 6              // Reduced from 8 to 6 for performance
+#define MAX_GRID_SIZE MOTION_MASK_MAX_GRID
 #define DEFAULT_DOWNSCALE_ENABLED true   // Enable downscaling for embedded devices
 #define DEFAULT_DOWNSCALE_FACTOR 2       // Downscale factor (2 = half size)
 #define MOTION_LABEL "motion"
+#define MOTION_VECTOR_MIN_PIXELS 2.0f    // Shorter vectors are encoder noise
+#define MOTION_VECTOR_CELL_SHARE 0.1f    // Share of a cell that must move for the cell to count
 #define EMBEDDED_DEVICE_OPTIMIZATION 1   // Enable embedded device optimizations
 
 // Structure to store frame data for temporal filtering
@@ -40,9 +48,26 @@ typedef struct {
     time_t timestamp;
 } frame_history_t;
 
+// Grid of a frame's motion vectors
+typedef struct {
+    uint32_t covered[MAX_GRID_SIZE * MAX_GRID_SIZE];  // Area of the blocks with a vector per cell
+    uint32_t moving[MAX_GRID_SIZE * MAX_GRID_SIZE];   // Area of those whose vector is long enough
+    float scores[MAX_GRID_SIZE * MAX_GRID_SIZE];      // Share of each cell that changed
+} motion_vector_grid_t;
+
 // Structure to store previous frame data for a stream
 typedef struct {
     char stream_name[MAX_STREAM_NAME];
+    unsigned char *arena;                // Scratch arena holding every buffer below
+    size_t arena_size;                   // Size of the arena in bytes
+    int arena_input_width;               // Input size the arena was laid out for
+    int arena_input_height;
+    int arena_factor;                    // Downscale factor the arena was laid out for
+    bool arena_stale;                    // History or grid settings changed since the layout
+    unsigned char *gray_frame;           // Full-size grayscale of RGB input (only when downscaling)
+    unsigned char *work_frame;           // Current grayscale frame at processing size
+    unsigned char *blur_temp;            // Intermediate of the two blur passes
+    uint16_t *blur_sums;                 // Running sums of the blur passes (width + 1)
     unsigned char *prev_frame;           // Previous grayscale frame
     unsigned char *blur_buffer;          // Buffer for blur operations
     unsigned char *background;           // Background model
@@ -50,6 +75,7 @@ typedef struct {
     int history_size;                    // Size of frame history buffer
     int history_index;                   // Current index in history buffer
     float *grid_scores;                  // Array to store grid cell motion scores
+    motion_vector_grid_t *vector_grid;   // Allocated with the first motion vectors
     int width;
     int height;
     int channels;
@@ -60,6 +86,9 @@ typedef struct {
     int noise_threshold;                 // Threshold for noise filtering
     bool use_grid_detection;             // Whether to use grid-based detection
     int grid_size;                       // Size of detection grid (grid_size x grid_size)
+    int configured_grid_size;            // Grid size to use without a motion mask
+    uint32_t mask[MAX_GRID_SIZE];        // Masked cells, bit gx of row gy
+    bool masked;                         // Whether any cell is masked
     time_t last_detection_time;
     bool enabled;
     bool downscale_enabled;              // Whether to downscale frames for processing
@@ -100,6 +129,27 @@ motion_stream_t* allocate_motion_stream(void) {
     return stream;
 }
 
+/**
+ * Free the scratch arena of a stream and clear the buffers pointing into it
+ */
+static void release_motion_arena(motion_stream_t *stream) {
+    if (stream->arena) {
+        memory_track(MEMORY_TAG_DETECTION, stream->arena_size, false);
+    }
+    free(stream->arena);
+    stream->arena = NULL;
+    stream->arena_size = 0;
+    stream->frame_history = NULL;
+    stream->grid_scores = NULL;
+    stream->prev_frame = NULL;
+    stream->blur_buffer = NULL;
+    stream->background = NULL;
+    stream->work_frame = NULL;
+    stream->blur_temp = NULL;
+    stream->blur_sums = NULL;
+    stream->gray_frame = NULL;
+}
+
 /**
  * Free a motion stream structure
  */
@@ -107,38 +157,11 @@ void free_motion_stream(motion_stream_t* stream) {
     if (!stream) return;
     
     pthread_mutex_lock(&stream->mutex);
-    
-    if (stream->prev_frame) {
-        free(stream->prev_frame);
-        stream->prev_frame = NULL;
-    }
-
-    if (stream->blur_buffer) {
-        free(stream->blur_buffer);
-        stream->blur_buffer = NULL;
-    }
 
-    if (stream->background) {
-        free(stream->background);
-        stream->background = NULL;
-    }
+    release_motion_arena(stream);
+    free(stream->vector_grid);
+    stream->vector_grid = NULL;
 
-    if (stream->grid_scores) {
-        free(stream->grid_scores);
-        stream->grid_scores = NULL;
-    }
-
-    if (stream->frame_history) {
-        for (int j = 0; j < stream->history_size; j++) {
-            if (stream->frame_history[j].frame) {
-                free(stream->frame_history[j].frame);
-                stream->frame_history[j].frame = NULL;  // Set to NULL after freeing to prevent double-free
-            }
-        }
-        free(stream->frame_history);
-        stream->frame_history = NULL;
-    }
-    
     pthread_mutex_unlock(&stream->mutex);
     pthread_mutex_destroy(&stream->mutex);
     
@@ -146,16 +169,17 @@ void free_motion_stream(motion_stream_t* stream) {
 }
 
 // Forward declarations for helper functions
-static void apply_box_blur(unsigned char *src, unsigned char *dst, int width, int height, int radius);
+static void apply_box_blur(const unsigned char *src, unsigned char *dst, unsigned char *temp,
+                           uint16_t *sums, int width, int height, int radius);
 static void update_background_model(unsigned char *background, const unsigned char *current,
                                     int width, int height, float learning_rate);
 static float calculate_grid_motion(const unsigned char *curr_frame, const unsigned char *prev_frame,
                                   const unsigned char *background, int width, int height,
                                   float sensitivity, int noise_threshold, int grid_size,
-                                  float *grid_scores, float *motion_area);
-static unsigned char *rgb_to_grayscale(const unsigned char *rgb_data, int width, int height);
-static unsigned char *downscale_grayscale(const unsigned char *src, int width, int height, int factor, 
-                                         int *out_width, int *out_height);
+                                  const uint32_t *mask, float *grid_scores, float *motion_area);
+static void rgb_to_grayscale(const unsigned char *rgb_data, int width, int height, unsigned char *gray_data);
+static void downscale_grayscale(const unsigned char *src, int stride, int width, int height, int factor,
+                                unsigned char *dst, int out_width, int out_height);
 
 /**
  * Initialize the motion detection system - optimized for embedded devices
@@ -216,53 +240,56 @@ static motion_stream_t *get_motion_stream(const char *stream_name) {
         init_motion_detection_system();
     }
 
+    // Entries are indexed by stream registry ID
+    int i = stream_registry_lookup(stream_name);
+    if (i < 0 || i >= MAX_MOTION_STREAMS) {
+        log_error("No available slots for motion detection stream: %s", stream_name);
+        return NULL;
+    }
+
     pthread_mutex_lock(&motion_streams_mutex);
 
     // Find existing entry
-    for (int i = 0; i < MAX_MOTION_STREAMS; i++) {
-        if (motion_streams[i] && motion_streams[i]->stream_name[0] != '\0' &&
-            strcmp(motion_streams[i]->stream_name, stream_name) == 0) {
-            pthread_mutex_unlock(&motion_streams_mutex);
-            return motion_streams[i];
-        }
+    if (motion_streams[i] && strcmp(motion_streams[i]->stream_name, stream_name) == 0) {
+        pthread_mutex_unlock(&motion_streams_mutex);
+        return motion_streams[i];
     }
 
-    // Create new entry
-    for (int i = 0; i < MAX_MOTION_STREAMS; i++) {
-        if (motion_streams[i] == NULL) {
-            // Allocate a new motion stream on the heap
-            motion_streams[i] = allocate_motion_stream();
-            if (!motion_streams[i]) {
-                log_error("Failed to allocate memory for motion stream");
-                pthread_mutex_unlock(&motion_streams_mutex);
-                return NULL;
-            }
-            
-            strncpy(motion_streams[i]->stream_name, stream_name, MAX_STREAM_NAME - 1);
-            motion_streams[i]->stream_name[MAX_STREAM_NAME - 1] = '\0';
-            
-            // Initialize default values
-            motion_streams[i]->sensitivity = DEFAULT_SENSITIVITY;
-            motion_streams[i]->min_motion_area = DEFAULT_MIN_MOTION_AREA;
-            motion_streams[i]->cooldown_time = DEFAULT_COOLDOWN_TIME;
-            motion_streams[i]->history_size = DEFAULT_MOTION_HISTORY;
-            motion_streams[i]->blur_radius = DEFAULT_BLUR_RADIUS;
-            motion_streams[i]->noise_threshold = DEFAULT_NOISE_THRESHOLD;
-            motion_streams[i]->use_grid_detection = DEFAULT_USE_GRID_DETECTION;
-            motion_streams[i]->grid_size = DEFAULT_GRID_SIZE;
-            motion_streams[i]->enabled = false;
-            motion_streams[i]->downscale_enabled = DEFAULT_DOWNSCALE_ENABLED;
-            motion_streams[i]->downscale_factor = DEFAULT_DOWNSCALE_FACTOR;
-            
-            log_info("Created new motion stream entry for %s", stream_name);
-            pthread_mutex_unlock(&motion_streams_mutex);
-            return motion_streams[i];
-        }
+    // The ID was reused after the previous stream was removed
+    if (motion_streams[i]) {
+        log_info("Releasing motion stream entry of removed stream %s", motion_streams[i]->stream_name);
+        free_motion_stream(motion_streams[i]);
+        motion_streams[i] = NULL;
     }
 
+    // Create new entry, allocated on the heap
+    motion_streams[i] = allocate_motion_stream();
+    if (!motion_streams[i]) {
+        log_error("Failed to allocate memory for motion stream");
+        pthread_mutex_unlock(&motion_streams_mutex);
+        return NULL;
+    }
+    
+    strncpy(motion_streams[i]->stream_name, stream_name, MAX_STREAM_NAME - 1);
+    motion_streams[i]->stream_name[MAX_STREAM_NAME - 1] = '\0';
+    
+    // Initialize default values
+    motion_streams[i]->sensitivity = DEFAULT_SENSITIVITY;
+    motion_streams[i]->min_motion_area = DEFAULT_MIN_MOTION_AREA;
+    motion_streams[i]->cooldown_time = DEFAULT_COOLDOWN_TIME;
+    motion_streams[i]->history_size = DEFAULT_MOTION_HISTORY;
+    motion_streams[i]->blur_radius = DEFAULT_BLUR_RADIUS;
+    motion_streams[i]->noise_threshold = DEFAULT_NOISE_THRESHOLD;
+    motion_streams[i]->use_grid_detection = DEFAULT_USE_GRID_DETECTION;
+    motion_streams[i]->grid_size = DEFAULT_GRID_SIZE;
+    motion_streams[i]->configured_grid_size = DEFAULT_GRID_SIZE;
+    motion_streams[i]->enabled = false;
+    motion_streams[i]->downscale_enabled = DEFAULT_DOWNSCALE_ENABLED;
+    motion_streams[i]->downscale_factor = DEFAULT_DOWNSCALE_FACTOR;
+    
+    log_info("Created new motion stream entry for %s", stream_name);
     pthread_mutex_unlock(&motion_streams_mutex);
-    log_error("No available slots for motion detection stream: %s", stream_name);
-    return NULL;
+    return motion_streams[i];
 }
 
 /**
@@ -332,29 +359,21 @@ int configure_advanced_motion_detection(const char *stream_name, int blur_radius
 
     stream->use_grid_detection = use_grid_detection;
 
-    stream->grid_size = (grid_size >= 2 && grid_size <= 32) ?
-                         grid_size : DEFAULT_GRID_SIZE;
+    stream->configured_grid_size = (grid_size >= 2 && grid_size <= MAX_GRID_SIZE) ?
+                                   grid_size : DEFAULT_GRID_SIZE;
+
+    // A motion mask keeps its own grid
+    if (!stream->masked) {
+        stream->grid_size = stream->configured_grid_size;
+    }
 
     // Validate history size
     int new_history_size = (history_size > 0 && history_size <= 10) ?
                            history_size : DEFAULT_MOTION_HISTORY;
 
-    // Reallocate grid_scores if grid size changed
-    if (stream->grid_size != old_grid_size && stream->grid_scores) {
-        free(stream->grid_scores);
-        stream->grid_scores = NULL;
-    }
-
-    // Reset frame history if size changed
-    if (new_history_size != old_history_size && stream->frame_history) {
-        for (int i = 0; i < old_history_size; i++) {
-            if (stream->frame_history[i].frame) {
-                free(stream->frame_history[i].frame);
-                stream->frame_history[i].frame = NULL;  // Set to NULL after freeing to prevent double-free
-            }
-        }
-        free(stream->frame_history);
-        stream->frame_history = NULL;
+    // Lay out the arena again on the next frame if its sizes changed
+    if (stream->grid_size != old_grid_size || new_history_size != old_history_size) {
+        stream->arena_stale = true;
     }
 
     stream->history_size = new_history_size;
@@ -408,6 +427,143 @@ int configure_motion_detection_optimizations(const char *stream_name, bool downs
     return 0;
 }
 
+static int hex_digit_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+/**
+ * Parse the text form of a stream's motion mask
+ */
+int parse_motion_mask(const char *text, uint32_t *rows) {
+    memset(rows, 0, MAX_GRID_SIZE * sizeof(uint32_t));
+
+    if (!text) {
+        return 0;
+    }
+    while (isspace((unsigned char)*text)) text++;
+    if (*text == '\0') {
+        return 0;
+    }
+
+    char *end;
+    long grid_size = strtol(text, &end, 10);
+    if (end == text || *end != ':' || grid_size < 2 || grid_size > MAX_GRID_SIZE) {
+        return -1;
+    }
+
+    const char *p = end + 1;
+    int digits = ((int)grid_size + 3) / 4;
+    for (int gy = 0; gy < grid_size; gy++) {
+        for (int d = 0; d < digits; d++, p++) {
+            int value = hex_digit_value(*p);
+            if (value < 0) {
+                return -1;
+            }
+            // Bits past the last column of the row are ignored
+            for (int bit = 0; bit < 4; bit++) {
+                int gx = d * 4 + bit;
+                if (gx < grid_size && (value & (8 >> bit))) {
+                    rows[gy] |= 1u << gx;
+                }
+            }
+        }
+    }
+
+    while (isspace((unsigned char)*p)) p++;
+    return *p == '\0' ? (int)grid_size : -1;
+}
+
+/**
+ * Write a motion mask in its text form
+ */
+int format_motion_mask(int grid_size, const uint32_t *rows, char *text, size_t size) {
+    if (!text || size == 0 || grid_size < 0 || grid_size > MAX_GRID_SIZE) {
+        return -1;
+    }
+    text[0] = '\0';
+
+    bool masked = false;
+    for (int gy = 0; gy < grid_size; gy++) {
+        masked |= rows[gy] != 0;
+    }
+    if (!masked || grid_size < 2) {
+        return 0;
+    }
+
+    int digits = (grid_size + 3) / 4;
+    size_t len = (size_t)snprintf(text, size, "%d:", grid_size);
+    if (len + (size_t)(grid_size * digits) >= size) {
+        text[0] = '\0';
+        return -1;
+    }
+
+    static const char hex[] = "0123456789abcdef";
+    for (int gy = 0; gy < grid_size; gy++) {
+        for (int d = 0; d < digits; d++) {
+            int value = 0;
+            for (int bit = 0; bit < 4; bit++) {
+                int gx = d * 4 + bit;
+                if (gx < grid_size && (rows[gy] & (1u << gx))) {
+                    value |= 8 >> bit;
+                }
+            }
+            text[len++] = hex[value];
+        }
+    }
+    text[len] = '\0';
+    return 0;
+}
+
+/**
+ * Set the cells of a stream's frame that motion detection ignores
+ */
+int configure_motion_mask(const char *stream_name, const char *mask_text) {
+    if (!stream_name) {
+        log_error("Invalid stream name for configure_motion_mask");
+        return -1;
+    }
+
+    uint32_t rows[MAX_GRID_SIZE];
+    int mask_grid_size = parse_motion_mask(mask_text, rows);
+    if (mask_grid_size < 0) {
+        log_error("Invalid motion mask for stream %s: %s", stream_name, mask_text);
+        return -1;
+    }
+
+    motion_stream_t *stream = get_motion_stream(stream_name);
+    if (!stream) {
+        log_error("Failed to get motion stream for %s", stream_name);
+        return -1;
+    }
+
+    int masked_cells = 0;
+    for (int gy = 0; gy < mask_grid_size; gy++) {
+        masked_cells += __builtin_popcount(rows[gy]);
+    }
+
+    pthread_mutex_lock(&stream->mutex);
+
+    int grid_size = masked_cells > 0 ? mask_grid_size : stream->configured_grid_size;
+    if (grid_size != stream->grid_size || memcmp(rows, stream->mask, sizeof(rows)) != 0) {
+        // Cells no longer masked have a stale background, so the model is seeded anew
+        stream->arena_stale = true;
+    }
+    stream->grid_size = grid_size;
+    memcpy(stream->mask, rows, sizeof(rows));
+    stream->masked = masked_cells > 0;
+
+    pthread_mutex_unlock(&stream->mutex);
+
+    if (masked_cells > 0) {
+        log_info("Configured motion mask for stream %s: %d of %d cells masked",
+                 stream_name, masked_cells, grid_size * grid_size);
+    }
+    return 0;
+}
+
 /**
  * Enable or disable motion detection for a stream
  */
@@ -427,36 +583,7 @@ int set_motion_detection_enabled(const char *stream_name, bool enabled) {
 
     // If disabling, free resources
     if (!enabled && stream->enabled) {
-        if (stream->prev_frame) {
-            free(stream->prev_frame);
-            stream->prev_frame = NULL;
-        }
-
-        if (stream->blur_buffer) {
-            free(stream->blur_buffer);
-            stream->blur_buffer = NULL;
-        }
-
-        if (stream->background) {
-            free(stream->background);
-            stream->background = NULL;
-        }
-
-        if (stream->grid_scores) {
-            free(stream->grid_scores);
-            stream->grid_scores = NULL;
-        }
-
-        if (stream->frame_history) {
-            for (int i = 0; i < stream->history_size; i++) {
-                if (stream->frame_history[i].frame) {
-                    free(stream->frame_history[i].frame);
-                    stream->frame_history[i].frame = NULL;  // Set to NULL after freeing to prevent double-free
-                }
-            }
-            free(stream->frame_history);
-            stream->frame_history = NULL;
-        }
+        release_motion_arena(stream);
 
         stream->width = 0;
         stream->height = 0;
@@ -498,117 +625,54 @@ bool is_motion_detection_enabled(const char *stream_name) {
 /**
  * Convert RGB frame to grayscale - optimized for embedded devices
  */
-static unsigned char *rgb_to_grayscale(const unsigned char *rgb_data, int width, int height) {
-    unsigned char *gray_data = (unsigned char *)malloc(width * height);
-    if (!gray_data) {
-        log_error("Failed to allocate memory for grayscale conversion");
-        return NULL;
-    }
-
-    #if EMBEDDED_DEVICE_OPTIMIZATION
-    // Use integer arithmetic for faster conversion
-    // Pre-compute fixed-point coefficients (8-bit fraction)
-    const int r_coeff = (int)(0.299f * 256);
-    const int g_coeff = (int)(0.587f * 256);
-    const int b_coeff = (int)(0.114f * 256);
-    
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            int rgb_idx = (y * width + x) * 3;
-            int gray_idx = y * width + x;
-
-            // Convert RGB to grayscale using integer arithmetic
-            int gray_value = (r_coeff * rgb_data[rgb_idx] + 
-                             g_coeff * rgb_data[rgb_idx + 1] + 
-                             b_coeff * rgb_data[rgb_idx + 2]) >> 8;
-                             
-            // Clamp to 0-255 range
-            if (gray_value > 255) gray_value = 255;
-            
-            gray_data[gray_idx] = (unsigned char)gray_value;
-        }
-    }
-    #else
-    // Original implementation for non-embedded devices
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            int rgb_idx = (y * width + x) * 3;
-            int gray_idx = y * width + x;
-
-            // Convert RGB to grayscale using standard luminance formula
-            gray_data[gray_idx] = (unsigned char)(
-                0.299f * rgb_data[rgb_idx] +      // R
-                0.587f * rgb_data[rgb_idx + 1] +  // G
-                0.114f * rgb_data[rgb_idx + 2]    // B
-            );
-        }
-    }
-    #endif
-
-    return gray_data;
+static void rgb_to_grayscale(const unsigned char *rgb_data, int width, int height, unsigned char *gray_data) {
+    // Integer BT.601 weights, vectorized where the CPU allows
+    motion_rgb_to_gray(rgb_data, gray_data, width * height);
 }
 
 /**
- * Downscale a grayscale image for faster processing
+ * Get the size frames are processed at
  */
-static unsigned char *downscale_grayscale(const unsigned char *src, int width, int height, int factor, 
-                                         int *out_width, int *out_height) {
+static void motion_processing_size(int width, int height, int factor, int *out_width, int *out_height) {
     if (factor <= 1) {
         // No downscaling needed
-        unsigned char *copy = (unsigned char *)malloc(width * height);
-        if (!copy) {
-            log_error("Failed to allocate memory for image copy");
-            return NULL;
-        }
-        memcpy(copy, src, width * height);
         *out_width = width;
         *out_height = height;
-        return copy;
+        return;
     }
-    
+
     // Calculate new dimensions
-    int new_width = width / factor;
-    int new_height = height / factor;
-    
+    *out_width = width / factor;
+    *out_height = height / factor;
+
     // Ensure minimum size
-    if (new_width < 32) new_width = 32;
-    if (new_height < 32) new_height = 32;
-    
-    // Allocate memory for downscaled image
-    unsigned char *dst = (unsigned char *)malloc(new_width * new_height);
-    if (!dst) {
-        log_error("Failed to allocate memory for downscaled image");
-        return NULL;
-    }
-    
-    // Perform downscaling by averaging blocks of pixels
-    for (int y = 0; y < new_height; y++) {
-        for (int x = 0; x < new_width; x++) {
-            int sum = 0;
-            int count = 0;
-            
-            // Average the pixels in the block
-            for (int dy = 0; dy < factor && (y * factor + dy) < height; dy++) {
-                for (int dx = 0; dx < factor && (x * factor + dx) < width; dx++) {
-                    sum += src[(y * factor + dy) * width + (x * factor + dx)];
-                    count++;
-                }
-            }
-            
-            // Store the average
-            dst[y * new_width + x] = (unsigned char)(sum / count);
+    if (*out_width < 32) *out_width = 32;
+    if (*out_height < 32) *out_height = 32;
+}
+
+/**
+ * Downscale a grayscale image for faster processing
+ * out_width and out_height come from motion_processing_size.
+ */
+static void downscale_grayscale(const unsigned char *src, int stride, int width, int height, int factor,
+                                unsigned char *dst, int out_width, int out_height) {
+    if (factor <= 1) {
+        // No downscaling needed, just drop the row padding
+        for (int y = 0; y < height; y++) {
+            memcpy(dst + y * width, src + (size_t)y * stride, width);
         }
+        return;
     }
-    
-    *out_width = new_width;
-    *out_height = new_height;
-    return dst;
+
+    // Perform downscaling by averaging blocks of pixels
+    motion_downscale_gray(src, stride, width, height, factor, dst, out_width, out_height);
 }
 
 /**
  * Apply a fast box blur to reduce noise - optimized for embedded devices
  */
-static void apply_box_blur(unsigned char *src, unsigned char *dst, int width, int height, int radius) {
+static void apply_box_blur(const unsigned char *src, unsigned char *dst, unsigned char *temp,
+                           uint16_t *sums, int width, int height, int radius) {
     // Skip if radius is 0
     if (radius <= 0) {
         memcpy(dst, src, width * height);
@@ -618,85 +682,13 @@ static void apply_box_blur(unsigned char *src, unsigned char *dst, int width, in
     // For embedded devices, use a faster approximation with reduced radius
     #if EMBEDDED_DEVICE_OPTIMIZATION
     // Use a simplified blur for embedded devices - horizontal and vertical passes
-    // Horizontal pass
-    for (int y = 0; y < height; y++) {
-        int row_offset = y * width;
-        
-        // Initialize sliding window sum for the row
-        int sum = 0;
-        int count = 0;
-        
-        // Initialize the sum with the first radius+1 pixels
-        for (int i = 0; i <= radius && i < width; i++) {
-            sum += src[row_offset + i];
-            count++;
-        }
-        
-        // Process first pixel
-        dst[row_offset] = (unsigned char)(sum / count);
-        
-        // Slide the window for the rest of the row
-        for (int x = 1; x < width; x++) {
-            // Add new pixel to the right
-            if (x + radius < width) {
-                sum += src[row_offset + x + radius];
-                count++;
-            }
-            
-            // Remove pixel from the left
-            if (x - radius - 1 >= 0) {
-                sum -= src[row_offset + x - radius - 1];
-                count--;
-            }
-            
-            dst[row_offset + x] = (unsigned char)(sum / count);
-        }
-    }
-    
-    // Vertical pass (using dst as source and writing back to dst)
-    unsigned char *temp = (unsigned char *)malloc(width * height);
-    if (!temp) {
-        // If memory allocation fails, just return the horizontal blur
-        return;
-    }
-    
-    memcpy(temp, dst, width * height);
-    
-    for (int x = 0; x < width; x++) {
-        // Initialize sliding window sum for the column
-        int sum = 0;
-        int count = 0;
-        
-        // Initialize the sum with the first radius+1 pixels
-        for (int i = 0; i <= radius && i < height; i++) {
-            sum += temp[i * width + x];
-            count++;
-        }
-        
-        // Process first pixel
-        dst[x] = (unsigned char)(sum / count);
-        
-        // Slide the window for the rest of the column
-        for (int y = 1; y < height; y++) {
-            // Add new pixel below
-            if (y + radius < height) {
-                sum += temp[(y + radius) * width + x];
-                count++;
-            }
-            
-            // Remove pixel from above
-            if (y - radius - 1 >= 0) {
-                sum -= temp[(y - radius - 1) * width + x];
-                count--;
-            }
-            
-            dst[y * width + x] = (unsigned char)(sum / count);
-        }
-    }
-    
-    free(temp);
-    temp = NULL;  // Set to NULL after freeing to prevent use-after-free
+    motion_box_blur_rows(src, temp, sums, width, height, radius);
+
+    // Vertical pass
+    motion_box_blur_cols(temp, dst, sums, width, height, radius);
     #else
+    (void)temp;
+    (void)sums;
     // Original implementation for non-embedded devices
     for (int y = 0; y < height; y++) {
         for (int x = 0; x < width; x++) {
@@ -739,13 +731,9 @@ static void update_background_model(unsigned char *background, const unsigned ch
     // For embedded devices, use integer arithmetic for speed
     // Convert learning_rate to fixed-point (8-bit fraction)
     int alpha = (int)(learning_rate * 256);
-    int inv_alpha = 256 - alpha;
-    
-    for (int i = 0; i < width * height; i++) {
-        // background = (1-alpha) * background + alpha * current
-        // Using fixed-point arithmetic (8-bit fraction)
-        background[i] = (unsigned char)((inv_alpha * background[i] + alpha * current[i]) >> 8);
-    }
+
+    // background = (1-alpha) * background + alpha * current
+    motion_blend_background(background, current, width * height, alpha);
     #else
     // Original implementation for non-embedded devices
     for (int i = 0; i < width * height; i++) {
@@ -758,11 +746,13 @@ static void update_background_model(unsigned char *background, const unsigned ch
 
 /**
  * Calculate motion using grid-based approach - optimized for embedded devices
+ * Masked cells are not read at all; they score 0 and the motion area is the
+ * fraction of the other cells that moved.
  */
 static float calculate_grid_motion(const unsigned char *curr_frame, const unsigned char *prev_frame,
                                   const unsigned char *background, int width, int height,
                                   float sensitivity, int noise_threshold, int grid_size,
-                                  float *grid_scores, float *motion_area) {
+                                  const uint32_t *mask, float *grid_scores, float *motion_area) {
     if (!curr_frame || !prev_frame || !background || !grid_scores || !motion_area) {
         return 0.0f;
     }
@@ -773,55 +763,51 @@ static float calculate_grid_motion(const unsigned char *curr_frame, const unsign
     int cells_with_motion = 0;
     float max_cell_score = 0.0f;
 
+    if (mask) {
+        for (int gy = 0; gy < grid_size; gy++) {
+            total_cells -= __builtin_popcount(mask[gy]);
+        }
+    }
+    if (total_cells <= 0) {
+        memset(grid_scores, 0, grid_size * grid_size * sizeof(float));
+        *motion_area = 0.0f;
+        return 0.0f;
+    }
+
     #if EMBEDDED_DEVICE_OPTIMIZATION
     // Convert sensitivity to fixed-point for faster comparison
     int sensitivity_threshold = (int)(sensitivity * 255.0f);
     
-    // Calculate motion for each grid cell
-    for (int gy = 0; gy < grid_size; gy++) {
-        for (int gx = 0; gx < grid_size; gx++) {
-            int cell_start_x = gx * cell_width;
-            int cell_start_y = gy * cell_height;
-            int cell_end_x = (gx + 1) * cell_width;
-            int cell_end_y = (gy + 1) * cell_height;
-
-            // Ensure we don't go out of bounds
-            if (cell_end_x > width) cell_end_x = width;
-            if (cell_end_y > height) cell_end_y = height;
+    // A pixel counts when its difference exceeds both thresholds
+    int threshold = noise_threshold > sensitivity_threshold ? noise_threshold : sensitivity_threshold;
 
-            int cell_pixels = 0;
-            int changed_pixels = 0;
-            int total_diff = 0;
-
-            // Process each pixel in the cell - use sampling for better performance
-            // Sample every other pixel in both dimensions
-            for (int y = cell_start_y; y < cell_end_y; y += 2) {
-                for (int x = cell_start_x; x < cell_end_x; x += 2) {
-                    int idx = y * width + x;
-
-                    // Calculate differences from previous frame and background
-                    int frame_diff = abs((int)curr_frame[idx] - (int)prev_frame[idx]);
-                    int bg_diff = abs((int)curr_frame[idx] - (int)background[idx]);
+    // Every other pixel in both dimensions is sampled from the cell's corner
+    int cell_pixels = ((cell_width + 1) / 2) * ((cell_height + 1) / 2);
 
-                    // Use the larger of the two differences
-                    int diff = (frame_diff > bg_diff) ? frame_diff : bg_diff;
-
-                    // Apply noise threshold
-                    if (diff > noise_threshold) {
-                        // Pixel difference exceeds sensitivity threshold
-                        if (diff > sensitivity_threshold) {
-                            changed_pixels++;
-                            total_diff += diff;
-                        }
-                    }
-
-                    cell_pixels++;
+    // Walk the frame once, a band of cells at a time, summing each row into its cells
+    uint32_t cell_diff[MAX_GRID_SIZE];
+    uint32_t full_row = grid_size == 32 ? 0xffffffffu : (1u << grid_size) - 1;
+    for (int gy = 0; gy < grid_size; gy++) {
+        uint32_t masked = mask ? mask[gy] : 0;
+        memset(cell_diff, 0, sizeof(cell_diff));
+
+        // A band of masked cells is skipped without reading its rows
+        for (int y = gy * cell_height; masked != full_row && y < (gy + 1) * cell_height; y += 2) {
+            int row = y * width;
+            for (int gx = 0; gx < grid_size; gx++) {
+                if (masked & (1u << gx)) {
+                    continue;
                 }
+                int idx = row + gx * cell_width;
+                uint32_t changed_pixels = 0;
+                motion_diff_sum(curr_frame + idx, prev_frame + idx, background + idx, cell_width, 2,
+                                threshold, &cell_diff[gx], &changed_pixels);
             }
+        }
 
+        for (int gx = 0; gx < grid_size; gx++) {
             // Calculate cell motion score
-            float cell_area = (float)changed_pixels / (float)cell_pixels;
-            float cell_score = (float)total_diff / (float)(cell_pixels * 255);
+            float cell_score = (float)cell_diff[gx] / (float)(cell_pixels * 255);
 
             // Store cell score
             int cell_idx = gy * grid_size + gx;
@@ -840,6 +826,11 @@ static float calculate_grid_motion(const unsigned char *curr_frame, const unsign
     // Original implementation for non-embedded devices
     for (int gy = 0; gy < grid_size; gy++) {
         for (int gx = 0; gx < grid_size; gx++) {
+            if (mask && (mask[gy] & (1u << gx))) {
+                grid_scores[gy * grid_size + gx] = 0.0f;
+                continue;
+            }
+
             int cell_start_x = gx * cell_width;
             int cell_start_y = gy * cell_height;
             int cell_end_x = (gx + 1) * cell_width;
@@ -913,18 +904,7 @@ static void add_frame_to_history(motion_stream_t *stream, const unsigned char *f
         return;
     }
 
-    // Free the old frame if it exists
-    if (stream->frame_history[stream->history_index].frame) {
-        free(stream->frame_history[stream->history_index].frame);
-    }
-
-    // Allocate and copy new frame
-    stream->frame_history[stream->history_index].frame = (unsigned char *)malloc(stream->width * stream->height);
-    if (!stream->frame_history[stream->history_index].frame) {
-        log_error("Failed to allocate memory for frame history");
-        return;
-    }
-
+    // Slots are preallocated in the arena
     memcpy(stream->frame_history[stream->history_index].frame, frame, stream->width * stream->height);
     stream->frame_history[stream->history_index].timestamp = timestamp;
 
@@ -954,213 +934,296 @@ static void update_memory_usage(motion_stream_t *stream, size_t allocated) {
 }
 
 /**
- * Process a frame for motion detection - optimized for embedded devices
+ * Look up and lock the motion stream for a new frame
+ * Returns NULL with status 0 when the frame is skipped (detection disabled or
+ * in cooldown) and with status -1 on error.
  */
-int detect_motion(const char *stream_name, const unsigned char *frame_data,
-                 int width, int height, int channels, time_t frame_time,
-                 detection_result_t *result) {
-    if (!stream_name || !frame_data || !result || width <= 0 || height <= 0 || channels <= 0) {
-        log_error("Invalid parameters for detect_motion");
-        return -1;
-    }
-
-    // Initialize result
-    memset(result, 0, sizeof(detection_result_t));
-
-    // Get motion stream
+static motion_stream_t *begin_motion_frame(const char *stream_name, time_t frame_time,
+                                           struct timespec *start_time, int *status) {
     motion_stream_t *stream = get_motion_stream(stream_name);
     if (!stream) {
         log_error("Failed to get motion stream for %s", stream_name);
-        return -1;
+        *status = -1;
+        return NULL;
     }
 
     pthread_mutex_lock(&stream->mutex);
-    
+
     // Start performance monitoring
-    struct timespec start_time;
-    clock_gettime(CLOCK_MONOTONIC, &start_time);
-    stream->last_frame_start = start_time;
-    
-    // Track memory usage
-    size_t current_memory = 0;
+    clock_gettime(CLOCK_MONOTONIC, start_time);
+    stream->last_frame_start = *start_time;
+
+    *status = 0;
 
     // Check if motion detection is enabled
     if (!stream->enabled) {
         pthread_mutex_unlock(&stream->mutex);
-        return 0;
+        return NULL;
     }
 
     // Check cooldown period
     if (stream->last_detection_time > 0 &&
         (frame_time - stream->last_detection_time) < stream->cooldown_time) {
         pthread_mutex_unlock(&stream->mutex);
+        return NULL;
+    }
+
+    return stream;
+}
+
+/**
+ * Round an arena region up so every region stays 16-byte aligned
+ */
+static size_t arena_region(size_t size) {
+    return (size + 15) & ~(size_t)15;
+}
+
+/**
+ * Lay out the scratch arena of a stream for an input resolution
+ * All per-frame buffers and the history ring live in one allocation, which
+ * is only replaced when the input size, the downscale factor or the history
+ * and grid sizes change, so steady-state processing never allocates.
+ *
+ * @return 1 if the arena was laid out anew (the frame seeds the background),
+ *         0 if it was reused, -1 on allocation failure
+ */
+static int prepare_motion_arena(motion_stream_t *stream, int width, int height, bool rgb_input) {
+    int factor = (stream->downscale_enabled && stream->downscale_factor > 1) ? stream->downscale_factor : 1;
+
+    // RGB input is converted at full size before downscaling
+    bool need_gray = rgb_input && factor > 1;
+
+    if (stream->arena && !stream->arena_stale &&
+        stream->arena_input_width == width && stream->arena_input_height == height &&
+        stream->arena_factor == factor && (!need_gray || stream->gray_frame)) {
         return 0;
     }
 
-    // Convert to grayscale if needed
-    unsigned char *gray_frame = NULL;
-    if (channels == 3) {
-        gray_frame = rgb_to_grayscale(frame_data, width, height);
-        if (!gray_frame) {
-            pthread_mutex_unlock(&stream->mutex);
-            return -1;
-        }
-        current_memory += width * height;
-    } else if (channels == 1) {
-        // If input is already grayscale, just make a copy
-        gray_frame = (unsigned char *)malloc(width * height);
-        if (!gray_frame) {
-            log_error("Failed to allocate memory for gray frame");
-            pthread_mutex_unlock(&stream->mutex);
-            return -1;
-        }
-        memcpy(gray_frame, frame_data, width * height);
-        current_memory += width * height;
-    } else {
-        log_error("Unsupported number of channels: %d", channels);
-        pthread_mutex_unlock(&stream->mutex);
+    int processing_width, processing_height;
+    motion_processing_size(width, height, factor, &processing_width, &processing_height);
+
+    size_t frame_size = arena_region((size_t)processing_width * processing_height);
+    size_t history_size = arena_region(stream->history_size * sizeof(frame_history_t));
+    size_t grid_size = arena_region(stream->grid_size * stream->grid_size * sizeof(float));
+    size_t sums_size = arena_region((size_t)(processing_width + 1) * sizeof(uint16_t));
+    size_t gray_size = need_gray ? arena_region((size_t)width * height) : 0;
+
+    // Previous, blurred, background, work and blur intermediate frames plus the history ring
+    size_t total = history_size + grid_size + sums_size + frame_size * (5 + stream->history_size) + gray_size;
+
+    release_motion_arena(stream);
+    stream->arena = (unsigned char *)calloc(1, total);
+    if (!stream->arena) {
+        log_error("Failed to allocate %zu byte motion detection arena for %s", total, stream->stream_name);
         return -1;
     }
 
-    // Downscale the frame if enabled
-    unsigned char *processing_frame = gray_frame;
-    int processing_width = width;
-    int processing_height = height;
-    
-    if (stream->downscale_enabled && stream->downscale_factor > 1) {
-        unsigned char *downscaled = downscale_grayscale(gray_frame, width, height, 
-                                                      stream->downscale_factor,
-                                                      &processing_width, &processing_height);
-        if (downscaled) {
-            // Use the downscaled frame for processing
-            free(gray_frame);
-            gray_frame = NULL;
-            processing_frame = downscaled;
-            
-            // Update memory tracking
-            current_memory = current_memory - (width * height) + (processing_width * processing_height);
-            
-            log_debug("Downscaled frame from %dx%d to %dx%d for motion detection",
-                     width, height, processing_width, processing_height);
-        } else {
-            log_warn("Failed to downscale frame, using original resolution");
+    unsigned char *p = stream->arena;
+    stream->frame_history = (frame_history_t *)p;
+    p += history_size;
+    stream->grid_scores = (float *)p;
+    p += grid_size;
+    stream->blur_sums = (uint16_t *)p;
+    p += sums_size;
+    stream->prev_frame = p;
+    p += frame_size;
+    stream->blur_buffer = p;
+    p += frame_size;
+    stream->background = p;
+    p += frame_size;
+    stream->work_frame = p;
+    p += frame_size;
+    stream->blur_temp = p;
+    p += frame_size;
+    for (int i = 0; i < stream->history_size; i++) {
+        stream->frame_history[i].frame = p;
+        p += frame_size;
+    }
+    stream->gray_frame = need_gray ? p : NULL;
+    stream->history_index = 0;
+
+    stream->arena_size = total;
+    memory_track(MEMORY_TAG_DETECTION, total, true);
+    stream->arena_input_width = width;
+    stream->arena_input_height = height;
+    stream->arena_factor = factor;
+    stream->arena_stale = false;
+
+    // Update dimensions
+    stream->width = processing_width;
+    stream->height = processing_height;
+    stream->channels = 1;  // We always store grayscale
+    stream->downscaled_width = processing_width;
+    stream->downscaled_height = processing_height;
+
+    log_info("Motion detection for %s: %dx%d input processed at %dx%d, %zu byte arena",
+             stream->stream_name, width, height, processing_width, processing_height, total);
+    return 1;
+}
+
+/**
+ * Set a box to the bounding rectangle of the grid cells with motion
+ * Cells are scored by calculate_grid_motion or detect_motion_vectors; the
+ * last row and column of cells also cover the pixels left over by the
+ * integer cell size.
+ *
+ * @param scores Cell scores, row by row
+ * @param grid_size Size of the grid
+ * @param cell_width Width of a cell, normalized
+ * @param cell_height Height of a cell, normalized
+ * @param threshold Cells scoring above this moved
+ * @param box Receives the box
+ */
+static void motion_region_from_grid(const float *scores, int grid_size, float cell_width, float cell_height,
+                                    float threshold, detection_t *box) {
+    int min_x = grid_size, min_y = grid_size, max_x = -1, max_y = -1;
+
+    for (int gy = 0; gy < grid_size; gy++) {
+        for (int gx = 0; gx < grid_size; gx++) {
+            if (scores[gy * grid_size + gx] > threshold) {
+                if (gx < min_x) min_x = gx;
+                if (gx > max_x) max_x = gx;
+                if (gy < min_y) min_y = gy;
+                if (gy > max_y) max_y = gy;
+            }
         }
     }
 
-    // Check if we need to allocate or reallocate resources
-    if (!stream->prev_frame || stream->width != processing_width || stream->height != processing_height) {
-        // Free old resources if they exist
-        if (stream->prev_frame) {
-            free(stream->prev_frame);
-            stream->prev_frame = NULL;
-        }
+    if (max_x < 0) {
+        // Motion spread too thinly for any one cell, report the whole frame
+        box->x = 0.0f;
+        box->y = 0.0f;
+        box->width = 1.0f;
+        box->height = 1.0f;
+        return;
+    }
 
-        if (stream->blur_buffer) {
-            free(stream->blur_buffer);
-            stream->blur_buffer = NULL;
-        }
+    box->x = min_x * cell_width;
+    box->y = min_y * cell_height;
+    box->width = (max_x == grid_size - 1 ? 1.0f : (max_x + 1) * cell_width) - box->x;
+    box->height = (max_y == grid_size - 1 ? 1.0f : (max_y + 1) * cell_height) - box->y;
+}
 
-        if (stream->background) {
-            free(stream->background);
-            stream->background = NULL;
-        }
+/**
+ * Whether every cell of a row of the grid is masked
+ */
+static bool mask_row_full(const motion_stream_t *stream, int gy) {
+    uint32_t full_row = stream->grid_size == 32 ? 0xffffffffu : (1u << stream->grid_size) - 1;
+    return (stream->mask[gy] & full_row) == full_row;
+}
+
+/**
+ * Blur the rows of grid cells that are not all masked into stream->blur_buffer
+ * Each run of such rows is blurred with radius rows of context above and
+ * below, so its pixels come out as a blur of the whole frame would give
+ * them. The rows of fully masked cells are left stale; nothing reads them.
+ */
+static void apply_masked_blur(motion_stream_t *stream, const unsigned char *src) {
+    int width = stream->width;
+    int height = stream->height;
+    int grid_size = stream->grid_size;
+    int cell_height = height / grid_size;
+    int radius = stream->blur_radius;
 
-        if (stream->grid_scores) {
-            free(stream->grid_scores);
-            stream->grid_scores = NULL;
+    int gy = 0;
+    while (gy < grid_size) {
+        if (mask_row_full(stream, gy)) {
+            gy++;
+            continue;
         }
 
-        if (stream->frame_history) {
-            for (int i = 0; i < stream->history_size; i++) {
-                if (stream->frame_history[i].frame) {
-                    free(stream->frame_history[i].frame);
-                }
-            }
-            free(stream->frame_history);
-            stream->frame_history = NULL;
+        int first = gy;
+        while (gy < grid_size && !mask_row_full(stream, gy)) {
+            gy++;
         }
 
-        // Allocate new resources
-        stream->prev_frame = (unsigned char *)malloc(processing_width * processing_height);
-        stream->blur_buffer = (unsigned char *)malloc(processing_width * processing_height);
-        stream->background = (unsigned char *)malloc(processing_width * processing_height);
+        int y0 = first * cell_height - radius;
+        int y1 = gy * cell_height + radius;
+        if (y0 < 0) y0 = 0;
+        if (y1 > height) y1 = height;
 
-        if (!stream->prev_frame || !stream->blur_buffer || !stream->background) {
-            log_error("Failed to allocate memory for motion detection buffers");
+        size_t offset = (size_t)y0 * width;
+        apply_box_blur(src + offset, stream->blur_buffer + offset, stream->blur_temp + offset,
+                       stream->blur_sums, width, y1 - y0, radius);
+    }
+}
 
-            if (stream->prev_frame) {
-                free(stream->prev_frame);
-                stream->prev_frame = NULL;
-            }
+/**
+ * Update the background model and the previous frame in the cells that are
+ * not masked, a row span of adjacent cells at a time
+ */
+static void update_unmasked_cells(motion_stream_t *stream, float learning_rate) {
+    int width = stream->width;
+    int grid_size = stream->grid_size;
+    int cell_width = width / grid_size;
+    int cell_height = stream->height / grid_size;
 
-            if (stream->blur_buffer) {
-                free(stream->blur_buffer);
-                stream->blur_buffer = NULL;
+    for (int gy = 0; gy < grid_size; gy++) {
+        uint32_t masked = stream->mask[gy];
+        int gx = 0;
+        while (gx < grid_size) {
+            if (masked & (1u << gx)) {
+                gx++;
+                continue;
             }
 
-            if (stream->background) {
-                free(stream->background);
-                stream->background = NULL;
+            int first = gx;
+            while (gx < grid_size && !(masked & (1u << gx))) {
+                gx++;
             }
 
-            free(processing_frame);
-            pthread_mutex_unlock(&stream->mutex);
-            return -1;
+            int span = (gx - first) * cell_width;
+            for (int y = gy * cell_height; y < (gy + 1) * cell_height; y++) {
+                size_t idx = (size_t)y * width + first * cell_width;
+                update_background_model(stream->background + idx, stream->blur_buffer + idx, span, 1,
+                                        learning_rate);
+                memcpy(stream->prev_frame + idx, stream->blur_buffer + idx, span);
+            }
         }
+    }
+}
 
+/**
+ * Run motion detection on a prepared grayscale frame
+ * Called with stream->mutex held; the frame is in stream->work_frame.
+ */
+static int analyze_motion_frame(motion_stream_t *stream, const char *stream_name, bool first_frame,
+                                time_t frame_time, const struct timespec *start_time,
+                                detection_result_t *result) {
+    unsigned char *processing_frame = stream->work_frame;
+    int processing_width = stream->width;
+    int processing_height = stream->height;
+
+    if (first_frame) {
         // Initialize the background with the current frame
         memcpy(stream->background, processing_frame, processing_width * processing_height);
         memcpy(stream->prev_frame, processing_frame, processing_width * processing_height);
-
-        // Allocate grid scores array
-        if (stream->use_grid_detection) {
-            stream->grid_scores = (float *)malloc(stream->grid_size * stream->grid_size * sizeof(float));
-            if (!stream->grid_scores) {
-                log_error("Failed to allocate memory for grid scores");
-                free(processing_frame);
-                pthread_mutex_unlock(&stream->mutex);
-                return -1;
-            }
-            memset(stream->grid_scores, 0, stream->grid_size * stream->grid_size * sizeof(float));
-        }
-
-        // Allocate frame history buffer
-        stream->frame_history = (frame_history_t *)malloc(stream->history_size * sizeof(frame_history_t));
-        if (!stream->frame_history) {
-            log_error("Failed to allocate memory for frame history");
-            free(processing_frame);
-            pthread_mutex_unlock(&stream->mutex);
-            return -1;
-        }
-        memset(stream->frame_history, 0, stream->history_size * sizeof(frame_history_t));
-        stream->history_index = 0;
-
-        // Update dimensions
-        stream->width = processing_width;
-        stream->height = processing_height;
-        stream->channels = 1;  // We always store grayscale
-        stream->downscaled_width = processing_width;
-        stream->downscaled_height = processing_height;
-
-        free(processing_frame);
-        pthread_mutex_unlock(&stream->mutex);
+        update_memory_usage(stream, stream->arena_size);
         return 0;  // Skip motion detection on first frame
     }
 
+    // A motion mask needs the grid, whose cells it masks
+    bool use_grid = stream->use_grid_detection || stream->masked;
+
     // Apply blur to reduce noise
-    apply_box_blur(processing_frame, stream->blur_buffer, processing_width, processing_height, stream->blur_radius);
+    if (stream->masked) {
+        apply_masked_blur(stream, processing_frame);
+    } else {
+        apply_box_blur(processing_frame, stream->blur_buffer, stream->blur_temp, stream->blur_sums,
+                       processing_width, processing_height, stream->blur_radius);
+    }
 
     bool motion_detected = false;
     float motion_score = 0.0f;
     float motion_area = 0.0f;
 
     // Detect motion between frames
-    if (stream->use_grid_detection) {
+    if (use_grid) {
         // Grid-based motion detection
         motion_score = calculate_grid_motion(
             stream->blur_buffer, stream->prev_frame, stream->background,
             processing_width, processing_height, stream->sensitivity, stream->noise_threshold,
-            stream->grid_size, stream->grid_scores, &motion_area
+            stream->grid_size, stream->masked ? stream->mask : NULL, stream->grid_scores, &motion_area
         );
 
         // Determine if motion is detected based on area threshold
@@ -1174,28 +1237,20 @@ int detect_motion(const char *stream_name, const unsigned char *frame_data,
         #if EMBEDDED_DEVICE_OPTIMIZATION
         // For embedded devices, use sampling to reduce computation
         // Process every other pixel in both dimensions
+        int noise_threshold = stream->noise_threshold;
+        int sensitivity_threshold = (int)(stream->sensitivity * 255.0f);
+        int threshold = noise_threshold > sensitivity_threshold ? noise_threshold : sensitivity_threshold;
+        uint32_t diff_sum = 0;
+        uint32_t changed_sum = 0;
+
         for (int y = 0; y < processing_height; y += 2) {
-            for (int x = 0; x < processing_width; x += 2) {
-                int idx = y * processing_width + x;
-                
-                // Calculate differences from previous frame and background
-                int frame_diff = abs((int)stream->blur_buffer[idx] - (int)stream->prev_frame[idx]);
-                int bg_diff = abs((int)stream->blur_buffer[idx] - (int)stream->background[idx]);
-
-                // Use the larger of the two differences
-                int diff = (frame_diff > bg_diff) ? frame_diff : bg_diff;
-
-                // Apply noise threshold
-                if (diff > stream->noise_threshold) {
-                    // Count pixels that changed more than the sensitivity threshold
-                    if (diff > (stream->sensitivity * 255.0f)) {
-                        changed_pixels++;
-                        total_diff += diff;
-                    }
-                }
-            }
+            int row = y * processing_width;
+            motion_diff_sum(stream->blur_buffer + row, stream->prev_frame + row, stream->background + row,
+                            processing_width, 2, threshold, &diff_sum, &changed_sum);
         }
-        
+        changed_pixels = (int)changed_sum;
+        total_diff = (int)diff_sum;
+
         // Adjust for sampling (we only processed 1/4 of the pixels)
         pixel_count = (processing_width * processing_height) / 4;
         #else
@@ -1233,10 +1288,15 @@ int detect_motion(const char *stream_name, const unsigned char *frame_data,
     // Update background model with a slow learning rate
     // Use a faster learning rate (0.05) when no motion is detected, slower (0.01) when motion is detected
     float learning_rate = motion_detected ? 0.01f : 0.05f;
-    update_background_model(stream->background, stream->blur_buffer, processing_width, processing_height, learning_rate);
+    if (stream->masked) {
+        // Masked cells are never compared, so their models are left as they are
+        update_unmasked_cells(stream, learning_rate);
+    } else {
+        update_background_model(stream->background, stream->blur_buffer, processing_width, processing_height, learning_rate);
 
-    // Copy current blurred frame to previous frame buffer for next comparison
-    memcpy(stream->prev_frame, stream->blur_buffer, processing_width * processing_height);
+        // Copy current blurred frame to previous frame buffer for next comparison
+        memcpy(stream->prev_frame, stream->blur_buffer, processing_width * processing_height);
+    }
 
     if (motion_detected) {
         // Update last detection time
@@ -1247,12 +1307,18 @@ int detect_motion(const char *stream_name, const unsigned char *frame_data,
         strncpy(result->detections[0].label, MOTION_LABEL, MAX_LABEL_LENGTH - 1);
         result->detections[0].confidence = motion_score;
 
-        // Set bounding box to cover the entire frame for now
-        // In a more advanced implementation, we could identify the specific motion regions
-        result->detections[0].x = 0.0f;
-        result->detections[0].y = 0.0f;
-        result->detections[0].width = 1.0f;
-        result->detections[0].height = 1.0f;
+        // With grid detection the box covers the cells that moved, otherwise the whole frame
+        if (use_grid) {
+            motion_region_from_grid(stream->grid_scores, stream->grid_size,
+                                    (float)(processing_width / stream->grid_size) / (float)processing_width,
+                                    (float)(processing_height / stream->grid_size) / (float)processing_height,
+                                    0.01f, &result->detections[0]);
+        } else {
+            result->detections[0].x = 0.0f;
+            result->detections[0].y = 0.0f;
+            result->detections[0].width = 1.0f;
+            result->detections[0].height = 1.0f;
+        }
 
         log_info("Motion detected in stream %s: score=%.3f, area=%.2f%%, confidence=%.2f",
                 stream_name, motion_score, motion_area * 100.0f, result->detections[0].confidence);
@@ -1262,17 +1328,14 @@ int detect_motion(const char *stream_name, const unsigned char *frame_data,
                  stream_name, motion_score, motion_area * 100.0f, stream->min_motion_area);
     }
 
-    // Clean up
-    free(processing_frame);
-    
     // End performance monitoring
     struct timespec end_time;
     clock_gettime(CLOCK_MONOTONIC, &end_time);
     
     // Calculate processing time in milliseconds
     float processing_time = 
-        (end_time.tv_sec - start_time.tv_sec) * 1000.0f + 
-        (end_time.tv_nsec - start_time.tv_nsec) / 1000000.0f;
+        (end_time.tv_sec - start_time->tv_sec) * 1000.0f + 
+        (end_time.tv_nsec - start_time->tv_nsec) / 1000000.0f;
     
     // Update performance statistics
     stream->last_processing_time = processing_time;
@@ -1289,10 +1352,224 @@ int detect_motion(const char *stream_name, const unsigned char *frame_data,
     }
     
     // Update memory usage statistics
-    update_memory_usage(stream, current_memory);
-    
+    update_memory_usage(stream, stream->arena_size);
+
+    return 0;
+}
+
+/**
+ * Process a frame for motion detection - optimized for embedded devices
+ */
+int detect_motion(const char *stream_name, const unsigned char *frame_data,
+                 int width, int height, int channels, time_t frame_time,
+                 detection_result_t *result) {
+    if (!stream_name || !frame_data || !result || width <= 0 || height <= 0 || channels <= 0) {
+        log_error("Invalid parameters for detect_motion");
+        return -1;
+    }
+
+    // Grayscale input is a luma plane without padding
+    if (channels == 1) {
+        return detect_motion_luma(stream_name, frame_data, width, width, height, frame_time, result);
+    }
+
+    // Initialize result
+    memset(result, 0, sizeof(detection_result_t));
+
+    if (channels != 3) {
+        log_error("Unsupported number of channels: %d", channels);
+        return -1;
+    }
+
+    struct timespec start_time;
+    int status;
+    motion_stream_t *stream = begin_motion_frame(stream_name, frame_time, &start_time, &status);
+    if (!stream) {
+        return status;
+    }
+
+    int first_frame = prepare_motion_arena(stream, width, height, true);
+    if (first_frame < 0) {
+        pthread_mutex_unlock(&stream->mutex);
+        return -1;
+    }
+
+    // Convert to grayscale, downscaling if enabled
+    if (stream->gray_frame) {
+        rgb_to_grayscale(frame_data, width, height, stream->gray_frame);
+        downscale_grayscale(stream->gray_frame, width, width, height, stream->arena_factor,
+                            stream->work_frame, stream->width, stream->height);
+    } else {
+        rgb_to_grayscale(frame_data, width, height, stream->work_frame);
+    }
+
+    int ret = analyze_motion_frame(stream, stream_name, first_frame == 1, frame_time, &start_time, result);
+
+    pthread_mutex_unlock(&stream->mutex);
+    return ret;
+}
+
+/**
+ * Process a luma plane for motion detection
+ * The plane is downscaled while it is read straight into the stream's arena.
+ */
+int detect_motion_luma(const char *stream_name, const uint8_t *luma, int linesize,
+                       int width, int height, time_t frame_time, detection_result_t *result) {
+    if (!stream_name || !luma || !result || width <= 0 || height <= 0 || linesize < width) {
+        log_error("Invalid parameters for detect_motion_luma");
+        return -1;
+    }
+
+    // Initialize result
+    memset(result, 0, sizeof(detection_result_t));
+
+    struct timespec start_time;
+    int status;
+    motion_stream_t *stream = begin_motion_frame(stream_name, frame_time, &start_time, &status);
+    if (!stream) {
+        return status;
+    }
+
+    int first_frame = prepare_motion_arena(stream, width, height, false);
+    if (first_frame < 0) {
+        pthread_mutex_unlock(&stream->mutex);
+        return -1;
+    }
+
+    downscale_grayscale(luma, linesize, width, height, stream->arena_factor,
+                        stream->work_frame, stream->width, stream->height);
+
+    int ret = analyze_motion_frame(stream, stream_name, first_frame == 1, frame_time, &start_time, result);
+
     pthread_mutex_unlock(&stream->mutex);
+    return ret;
+}
+
+/**
+ * Process the motion vectors a decoder exported for a frame
+ * Vectors are binned into the grid by the center of their block, so a cell
+ * sums the area of the blocks predicted into it. Bi-predicted blocks bring
+ * two vectors, which at worst hides intra blocks of the same cell.
+ */
+int detect_motion_vectors(const char *stream_name, const AVMotionVector *vectors, int count,
+                          int width, int height, time_t frame_time, detection_result_t *result) {
+    if (!stream_name || (!vectors && count > 0) || count < 0 || !result || width <= 0 || height <= 0) {
+        log_error("Invalid parameters for detect_motion_vectors");
+        return -1;
+    }
+
+    // Initialize result
+    memset(result, 0, sizeof(detection_result_t));
+
+    struct timespec start_time;
+    int status;
+    motion_stream_t *stream = begin_motion_frame(stream_name, frame_time, &start_time, &status);
+    if (!stream) {
+        return status;
+    }
+
+    int grid_size = stream->grid_size;
+    int cells = grid_size * grid_size;
+    if (!stream->vector_grid) {
+        stream->vector_grid = malloc(sizeof(motion_vector_grid_t));
+        if (!stream->vector_grid) {
+            log_error("Failed to allocate motion vector grid for %s", stream_name);
+            pthread_mutex_unlock(&stream->mutex);
+            return -1;
+        }
+    }
+    uint32_t *covered = stream->vector_grid->covered;
+    uint32_t *moving = stream->vector_grid->moving;
+    float *scores = stream->vector_grid->scores;
+    memset(covered, 0, cells * sizeof(uint32_t));
+    memset(moving, 0, cells * sizeof(uint32_t));
+
+    float min_length_sq = MOTION_VECTOR_MIN_PIXELS * MOTION_VECTOR_MIN_PIXELS;
+    for (int i = 0; i < count; i++) {
+        const AVMotionVector *mv = &vectors[i];
+        if (mv->dst_x < 0 || mv->dst_x >= width || mv->dst_y < 0 || mv->dst_y >= height) {
+            continue;
+        }
+
+        int gx = mv->dst_x * grid_size / width;
+        int gy = mv->dst_y * grid_size / height;
+        if (stream->masked && (stream->mask[gy] & (1u << gx))) {
+            continue;
+        }
+
+        float dx, dy;
+        if (mv->motion_scale > 0) {
+            dx = (float)mv->motion_x / (float)mv->motion_scale;
+            dy = (float)mv->motion_y / (float)mv->motion_scale;
+        } else {
+            dx = (float)(mv->src_x - mv->dst_x);
+            dy = (float)(mv->src_y - mv->dst_y);
+        }
+
+        uint32_t area = (uint32_t)mv->w * mv->h;
+        covered[gy * grid_size + gx] += area;
+        if (dx * dx + dy * dy >= min_length_sq) {
+            moving[gy * grid_size + gx] += area;
+        }
+    }
 
+    uint32_t cell_area = (uint32_t)((width / grid_size) * (height / grid_size));
+    int active_cells = 0;
+    int cells_with_motion = 0;
+    float motion_score = 0.0f;
+    for (int i = 0; i < cells; i++) {
+        if (stream->masked && (stream->mask[i / grid_size] & (1u << (i % grid_size)))) {
+            scores[i] = 0.0f;
+            continue;
+        }
+        active_cells++;
+
+        // Intra blocks are the area no vector covers
+        uint32_t intra = covered[i] < cell_area ? cell_area - covered[i] : 0;
+        uint32_t changed = moving[i] + intra;
+        float score = cell_area > 0 ? (float)(changed < cell_area ? changed : cell_area) / (float)cell_area : 0.0f;
+
+        scores[i] = score;
+        if (score > MOTION_VECTOR_CELL_SHARE) {
+            cells_with_motion++;
+            if (score > motion_score) {
+                motion_score = score;
+            }
+        }
+    }
+
+    float motion_area = active_cells > 0 ? (float)cells_with_motion / (float)active_cells : 0.0f;
+    if (cells_with_motion > 0 && motion_area >= stream->min_motion_area) {
+        stream->last_detection_time = frame_time;
+
+        result->count = 1;
+        strncpy(result->detections[0].label, MOTION_LABEL, MAX_LABEL_LENGTH - 1);
+        result->detections[0].confidence = motion_score;
+        motion_region_from_grid(scores, grid_size,
+                                (float)(width / grid_size) / (float)width,
+                                (float)(height / grid_size) / (float)height,
+                                MOTION_VECTOR_CELL_SHARE, &result->detections[0]);
+
+        log_info("Motion vectors show motion in stream %s: score=%.3f, area=%.2f%%",
+                 stream_name, motion_score, motion_area * 100.0f);
+    } else {
+        log_debug("No motion in the vectors of stream %s: area=%.2f%%, threshold=%.2f",
+                  stream_name, motion_area * 100.0f, stream->min_motion_area);
+    }
+
+    struct timespec end_time;
+    clock_gettime(CLOCK_MONOTONIC, &end_time);
+    float processing_time = (end_time.tv_sec - start_time.tv_sec) * 1000.0f +
+                            (end_time.tv_nsec - start_time.tv_nsec) / 1000000.0f;
+    stream->last_processing_time = processing_time;
+    stream->frames_processed++;
+    stream->avg_processing_time = (stream->avg_processing_time * (stream->frames_processed - 1) + processing_time) /
+                                  stream->frames_processed;
+    if (processing_time > stream->peak_processing_time) {
+        stream->peak_processing_time = processing_time;
+    }
+
+    pthread_mutex_unlock(&stream->mutex);
     return 0;
 }
 
@@ -0,0 +1,933 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "core/logger.h"
+#include "video/motion_kernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define MOTION_KERNELS_X86 1
+#include <immintrin.h>
+#elif defined(__aarch64__) || defined(__ARM_NEON)
+#define MOTION_KERNELS_NEON 1
+#include <arm_neon.h>
+#endif
+
+// Fixed-point BT.601 weights with an 8-bit fraction; they add up to 255, so the
+// weighted sum of a pixel always fits in 16 bits
+#define GRAY_WEIGHT_R 76
+#define GRAY_WEIGHT_G 150
+#define GRAY_WEIGHT_B 29
+
+// Widest blur the vector code handles: dividing by the reciprocal in 16 bits is
+// exact for windows of up to 16 pixels
+#define MAX_VECTOR_RADIUS 7
+
+/**
+ * Vector spans of the kernels
+ * Each span handles the part of a row it can and returns where it stopped;
+ * the drivers finish edges and tails with the scalar helpers. NULL spans
+ * fall back to the scalar reference for the whole image.
+ */
+typedef struct {
+    const char *isa;
+    int (*gray_span)(const uint8_t *rgb, uint8_t *gray, int pixels);
+    int (*blur_row_span)(const uint8_t *row, uint8_t *out, uint16_t *sums, int width, int radius,
+                         uint16_t reciprocal);
+    int (*blur_col_step)(uint16_t *sums, uint8_t *out, const uint8_t *add, const uint8_t *sub,
+                         int width, uint16_t reciprocal);
+    int (*downscale_span)(const uint8_t *src, int stride, int width, int factor, int y, uint8_t *out, int out_width);
+    int (*diff_span)(const uint8_t *cur, const uint8_t *prev, const uint8_t *bg, int count, int step,
+                     int threshold, uint32_t *sum, uint32_t *changed);
+    int (*blend_span)(uint8_t *background, const uint8_t *current, int pixels, int alpha);
+} motion_kernels_t;
+
+static motion_kernels_t kernels = { .isa = "scalar" };
+static pthread_once_t kernels_once = PTHREAD_ONCE_INIT;
+
+/* Scalar reference */
+
+static inline uint8_t gray_pixel(const uint8_t *rgb) {
+    return (uint8_t)((GRAY_WEIGHT_R * rgb[0] + GRAY_WEIGHT_G * rgb[1] + GRAY_WEIGHT_B * rgb[2]) >> 8);
+}
+
+/**
+ * Larger of the differences of a pixel to the previous frame and the background
+ */
+static inline int pixel_diff(uint8_t cur, uint8_t prev, uint8_t bg) {
+    int frame_diff = abs((int)cur - (int)prev);
+    int bg_diff = abs((int)cur - (int)bg);
+    return frame_diff > bg_diff ? frame_diff : bg_diff;
+}
+
+/**
+ * Mean of the pixels within radius of x on a row
+ */
+static inline uint8_t row_mean(const uint8_t *row, int width, int x, int radius) {
+    int first = x - radius < 0 ? 0 : x - radius;
+    int last = x + radius >= width ? width - 1 : x + radius;
+    int sum = 0;
+    for (int i = first; i <= last; i++) {
+        sum += row[i];
+    }
+    return (uint8_t)(sum / (last - first + 1));
+}
+
+/**
+ * Mean of the pixels within radius of y in column x
+ */
+static inline uint8_t col_mean(const uint8_t *src, int width, int height, int x, int y, int radius) {
+    int first = y - radius < 0 ? 0 : y - radius;
+    int last = y + radius >= height ? height - 1 : y + radius;
+    int sum = 0;
+    for (int i = first; i <= last; i++) {
+        sum += src[i * width + x];
+    }
+    return (uint8_t)(sum / (last - first + 1));
+}
+
+/**
+ * Mean of the block of output pixel (x, y), clipped to the source
+ */
+static inline uint8_t block_mean(const uint8_t *src, int stride, int width, int height, int factor, int x, int y) {
+    int sum = 0;
+    int count = 0;
+    for (int dy = 0; dy < factor && (y * factor + dy) < height; dy++) {
+        for (int dx = 0; dx < factor && (x * factor + dx) < width; dx++) {
+            sum += src[(size_t)(y * factor + dy) * stride + (x * factor + dx)];
+            count++;
+        }
+    }
+    return count > 0 ? (uint8_t)(sum / count) : 0;
+}
+
+/**
+ * Horizontal pass as a sliding window sum over each row
+ */
+static void blur_rows_scalar(const uint8_t *src, uint8_t *dst, int width, int height, int radius) {
+    for (int y = 0; y < height; y++) {
+        const uint8_t *row = src + (size_t)y * width;
+        uint8_t *out = dst + (size_t)y * width;
+        int sum = 0;
+        int count = 0;
+
+        for (int i = 0; i <= radius && i < width; i++) {
+            sum += row[i];
+            count++;
+        }
+        out[0] = (uint8_t)(sum / count);
+
+        for (int x = 1; x < width; x++) {
+            if (x + radius < width) {
+                sum += row[x + radius];
+                count++;
+            }
+            if (x - radius - 1 >= 0) {
+                sum -= row[x - radius - 1];
+                count--;
+            }
+            out[x] = (uint8_t)(sum / count);
+        }
+    }
+}
+
+/**
+ * Vertical pass as a sliding window sum down each column
+ */
+static void blur_cols_scalar(const uint8_t *src, uint8_t *dst, int width, int height, int radius) {
+    for (int x = 0; x < width; x++) {
+        int sum = 0;
+        int count = 0;
+
+        for (int i = 0; i <= radius && i < height; i++) {
+            sum += src[(size_t)i * width + x];
+            count++;
+        }
+        dst[x] = (uint8_t)(sum / count);
+
+        for (int y = 1; y < height; y++) {
+            if (y + radius < height) {
+                sum += src[(size_t)(y + radius) * width + x];
+                count++;
+            }
+            if (y - radius - 1 >= 0) {
+                sum -= src[(size_t)(y - radius - 1) * width + x];
+                count--;
+            }
+            dst[(size_t)y * width + x] = (uint8_t)(sum / count);
+        }
+    }
+}
+
+#if MOTION_KERNELS_X86
+
+/* SSE2 / SSSE3 */
+
+// The AVX2 spans finish their tails with these, and the AVX2 table reuses
+// some whole. Always inlining them compiles those copies as VEX code inside
+// the AVX2 functions: calling legacy SSE code with the upper halves of the
+// ymm registers dirty stalls on every switch, which made the AVX2 table
+// slower than SSE2.
+#define SSE_SPAN static inline __attribute__((always_inline))
+
+__attribute__((target("ssse3")))
+SSE_SPAN int gray_span_ssse3(const uint8_t *rgb, uint8_t *gray, int pixels) {
+    // Byte shuffles picking R, G and B of 8 pixels into 16-bit lanes; the first
+    // load covers bytes 0-15 of the pixels, the second bytes 8-23
+    const __m128i r_lo = _mm_setr_epi8(0, -1, 3, -1, 6, -1, 9, -1, 12, -1, 15, -1, -1, -1, -1, -1);
+    const __m128i r_hi = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 10, -1, 13, -1);
+    const __m128i g_lo = _mm_setr_epi8(1, -1, 4, -1, 7, -1, 10, -1, 13, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i g_hi = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 8, -1, 11, -1, 14, -1);
+    const __m128i b_lo = _mm_setr_epi8(2, -1, 5, -1, 8, -1, 11, -1, 14, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i b_hi = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 9, -1, 12, -1, 15, -1);
+    const __m128i wr = _mm_set1_epi16(GRAY_WEIGHT_R);
+    const __m128i wg = _mm_set1_epi16(GRAY_WEIGHT_G);
+    const __m128i wb = _mm_set1_epi16(GRAY_WEIGHT_B);
+
+    int i = 0;
+    for (; i + 8 <= pixels; i += 8) {
+        const uint8_t *p = rgb + (size_t)i * 3;
+        __m128i v0 = _mm_loadu_si128((const __m128i *)p);
+        __m128i v1 = _mm_loadu_si128((const __m128i *)(p + 8));
+
+        __m128i r = _mm_or_si128(_mm_shuffle_epi8(v0, r_lo), _mm_shuffle_epi8(v1, r_hi));
+        __m128i g = _mm_or_si128(_mm_shuffle_epi8(v0, g_lo), _mm_shuffle_epi8(v1, g_hi));
+        __m128i b = _mm_or_si128(_mm_shuffle_epi8(v0, b_lo), _mm_shuffle_epi8(v1, b_hi));
+
+        __m128i y = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(r, wr), _mm_mullo_epi16(g, wg)),
+                                  _mm_mullo_epi16(b, wb));
+        y = _mm_srli_epi16(y, 8);
+        _mm_storel_epi64((__m128i *)(gray + i), _mm_packus_epi16(y, y));
+    }
+    return i;
+}
+
+/**
+ * Wrapping 16-bit prefix sums of a row: sums[i] is row[0] + ... + row[i - 1]
+ * A window sum is the difference of two entries, exact modulo 2^16.
+ */
+__attribute__((target("sse2")))
+SSE_SPAN void prefix_sums_sse2(const uint8_t *row, uint16_t *sums, int width) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i carry = zero;
+
+    sums[0] = 0;
+    int i = 0;
+    for (; i + 8 <= width; i += 8) {
+        __m128i v = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(row + i)), zero);
+        v = _mm_add_epi16(v, _mm_slli_si128(v, 2));
+        v = _mm_add_epi16(v, _mm_slli_si128(v, 4));
+        v = _mm_add_epi16(v, _mm_slli_si128(v, 8));
+        v = _mm_add_epi16(v, carry);
+        _mm_storeu_si128((__m128i *)(sums + i + 1), v);
+        carry = _mm_set1_epi16((short)_mm_extract_epi16(v, 7));
+    }
+
+    uint16_t total = (uint16_t)_mm_extract_epi16(carry, 0);
+    for (; i < width; i++) {
+        total = (uint16_t)(total + row[i]);
+        sums[i + 1] = total;
+    }
+}
+
+__attribute__((target("sse2")))
+SSE_SPAN int blur_row_span_sse2(const uint8_t *row, uint8_t *out, uint16_t *sums, int width, int radius,
+                              uint16_t reciprocal) {
+    const __m128i m = _mm_set1_epi16((short)reciprocal);
+
+    prefix_sums_sse2(row, sums, width);
+
+    // The window of x is sums[x + radius + 1] - sums[x - radius]
+    int x = radius;
+    for (; x + 16 + radius <= width; x += 16) {
+        __m128i lo = _mm_sub_epi16(_mm_loadu_si128((const __m128i *)(sums + x + radius + 1)),
+                                   _mm_loadu_si128((const __m128i *)(sums + x - radius)));
+        __m128i hi = _mm_sub_epi16(_mm_loadu_si128((const __m128i *)(sums + x + radius + 9)),
+                                   _mm_loadu_si128((const __m128i *)(sums + x - radius + 8)));
+        _mm_storeu_si128((__m128i *)(out + x), _mm_packus_epi16(_mm_mulhi_epu16(lo, m), _mm_mulhi_epu16(hi, m)));
+    }
+    return x;
+}
+
+__attribute__((target("sse2")))
+SSE_SPAN int blur_col_step_sse2(uint16_t *sums, uint8_t *out, const uint8_t *add, const uint8_t *sub,
+                              int width, uint16_t reciprocal) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i m = _mm_set1_epi16((short)reciprocal);
+
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i lo = _mm_loadu_si128((const __m128i *)(sums + x));
+        __m128i hi = _mm_loadu_si128((const __m128i *)(sums + x + 8));
+        if (out) {
+            _mm_storeu_si128((__m128i *)(out + x), _mm_packus_epi16(_mm_mulhi_epu16(lo, m), _mm_mulhi_epu16(hi, m)));
+        }
+        if (add) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(add + x));
+            lo = _mm_add_epi16(lo, _mm_unpacklo_epi8(v, zero));
+            hi = _mm_add_epi16(hi, _mm_unpackhi_epi8(v, zero));
+        }
+        if (sub) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(sub + x));
+            lo = _mm_sub_epi16(lo, _mm_unpacklo_epi8(v, zero));
+            hi = _mm_sub_epi16(hi, _mm_unpackhi_epi8(v, zero));
+        }
+        _mm_storeu_si128((__m128i *)(sums + x), lo);
+        _mm_storeu_si128((__m128i *)(sums + x + 8), hi);
+    }
+    return x;
+}
+
+__attribute__((target("sse2")))
+SSE_SPAN int downscale_span_sse2(const uint8_t *src, int stride, int width, int factor, int y, uint8_t *out, int out_width) {
+    const __m128i low_bytes = _mm_set1_epi16(0x00FF);
+    const __m128i ones = _mm_set1_epi16(1);
+    int x = 0;
+
+    if (factor == 2) {
+        const uint8_t *row0 = src + (size_t)(y * 2) * stride;
+        const uint8_t *row1 = row0 + stride;
+        for (; x + 8 <= out_width && x * 2 + 16 <= width; x += 8) {
+            __m128i a = _mm_loadu_si128((const __m128i *)(row0 + x * 2));
+            __m128i b = _mm_loadu_si128((const __m128i *)(row1 + x * 2));
+            __m128i sum = _mm_add_epi16(_mm_add_epi16(_mm_and_si128(a, low_bytes), _mm_srli_epi16(a, 8)),
+                                        _mm_add_epi16(_mm_and_si128(b, low_bytes), _mm_srli_epi16(b, 8)));
+            sum = _mm_srli_epi16(sum, 2);
+            _mm_storel_epi64((__m128i *)(out + x), _mm_packus_epi16(sum, sum));
+        }
+    } else if (factor == 4) {
+        const uint8_t *row = src + (size_t)(y * 4) * stride;
+        for (; x + 4 <= out_width && x * 4 + 16 <= width; x += 4) {
+            __m128i sum = _mm_setzero_si128();
+            for (int dy = 0; dy < 4; dy++) {
+                __m128i v = _mm_loadu_si128((const __m128i *)(row + (size_t)dy * stride + x * 4));
+                __m128i pairs = _mm_add_epi16(_mm_and_si128(v, low_bytes), _mm_srli_epi16(v, 8));
+                sum = _mm_add_epi32(sum, _mm_madd_epi16(pairs, ones));
+            }
+            sum = _mm_srli_epi32(sum, 4);
+            __m128i packed = _mm_packs_epi32(sum, sum);
+            packed = _mm_packus_epi16(packed, packed);
+            int value = _mm_cvtsi128_si32(packed);
+            memcpy(out + x, &value, 4);
+        }
+    }
+    return x;
+}
+
+/**
+ * Larger of |a - b| and |a - c| per byte
+ */
+__attribute__((target("sse2")))
+SSE_SPAN __m128i max_absdiff_sse2(__m128i a, __m128i b, __m128i c) {
+    __m128i ab = _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a));
+    __m128i ac = _mm_or_si128(_mm_subs_epu8(a, c), _mm_subs_epu8(c, a));
+    return _mm_max_epu8(ab, ac);
+}
+
+__attribute__((target("sse2")))
+SSE_SPAN int diff_span_sse2(const uint8_t *cur, const uint8_t *prev, const uint8_t *bg, int count, int step,
+                          int threshold, uint32_t *sum, uint32_t *changed) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ones = _mm_set1_epi8(1);
+    // d > threshold is tested as max(d, threshold + 1) == d; callers keep threshold below 255
+    const __m128i above = _mm_set1_epi8((char)(threshold + 1));
+    // With step 2 only the even bytes of each block are sampled
+    const __m128i sampled = step == 2 ? _mm_set1_epi16(0x00FF) : _mm_set1_epi8(-1);
+    __m128i acc_sum = zero;
+    __m128i acc_changed = zero;
+
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i d = max_absdiff_sse2(_mm_loadu_si128((const __m128i *)(cur + i)),
+                                     _mm_loadu_si128((const __m128i *)(prev + i)),
+                                     _mm_loadu_si128((const __m128i *)(bg + i)));
+        __m128i mask = _mm_and_si128(_mm_cmpeq_epi8(_mm_max_epu8(d, above), d), sampled);
+        acc_sum = _mm_add_epi64(acc_sum, _mm_sad_epu8(_mm_and_si128(d, mask), zero));
+        acc_changed = _mm_add_epi64(acc_changed, _mm_sad_epu8(_mm_and_si128(mask, ones), zero));
+    }
+
+    *sum += (uint32_t)_mm_cvtsi128_si32(acc_sum) + (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(acc_sum, 8));
+    *changed += (uint32_t)_mm_cvtsi128_si32(acc_changed) +
+                (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(acc_changed, 8));
+    return i;
+}
+
+__attribute__((target("sse2")))
+SSE_SPAN int blend_span_sse2(uint8_t *background, const uint8_t *current, int pixels, int alpha) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i a = _mm_set1_epi16((short)alpha);
+    const __m128i inv_a = _mm_set1_epi16((short)(256 - alpha));
+
+    int i = 0;
+    for (; i + 16 <= pixels; i += 16) {
+        __m128i b = _mm_loadu_si128((const __m128i *)(background + i));
+        __m128i c = _mm_loadu_si128((const __m128i *)(current + i));
+        // At most 256 * 255, so the 16-bit sums cannot overflow
+        __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(b, zero), inv_a),
+                                   _mm_mullo_epi16(_mm_unpacklo_epi8(c, zero), a));
+        __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(b, zero), inv_a),
+                                   _mm_mullo_epi16(_mm_unpackhi_epi8(c, zero), a));
+        _mm_storeu_si128((__m128i *)(background + i),
+                         _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8)));
+    }
+    return i;
+}
+
+/* AVX2 */
+
+// Reasonably cheap already with 128-bit vectors; these only get the VEX encoding
+__attribute__((target("avx2")))
+static int blur_row_span_avx2(const uint8_t *row, uint8_t *out, uint16_t *sums, int width, int radius,
+                              uint16_t reciprocal) {
+    return blur_row_span_sse2(row, out, sums, width, radius, reciprocal);
+}
+
+__attribute__((target("avx2")))
+static int downscale_span_avx2(const uint8_t *src, int stride, int width, int factor, int y, uint8_t *out,
+                               int out_width) {
+    return downscale_span_sse2(src, stride, width, factor, y, out, out_width);
+}
+
+__attribute__((target("avx2")))
+static int gray_span_avx2(const uint8_t *rgb, uint8_t *gray, int pixels) {
+    // Same shuffles as SSSE3, one group of 8 pixels per 128-bit lane
+    const __m256i r_lo = _mm256_broadcastsi128_si256(
+        _mm_setr_epi8(0, -1, 3, -1, 6, -1, 9, -1, 12, -1, 15, -1, -1, -1, -1, -1));
+    const __m256i r_hi = _mm256_broadcastsi128_si256(
+        _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 10, -1, 13, -1));
+    const __m256i g_lo = _mm256_broadcastsi128_si256(
+        _mm_setr_epi8(1, -1, 4, -1, 7, -1, 10, -1, 13, -1, -1, -1, -1, -1, -1, -1));
+    const __m256i g_hi = _mm256_broadcastsi128_si256(
+        _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 8, -1, 11, -1, 14, -1));
+    const __m256i b_lo = _mm256_broadcastsi128_si256(
+        _mm_setr_epi8(2, -1, 5, -1, 8, -1, 11, -1, 14, -1, -1, -1, -1, -1, -1, -1));
+    const __m256i b_hi = _mm256_broadcastsi128_si256(
+        _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 9, -1, 12, -1, 15, -1));
+    const __m256i wr = _mm256_set1_epi16(GRAY_WEIGHT_R);
+    const __m256i wg = _mm256_set1_epi16(GRAY_WEIGHT_G);
+    const __m256i wb = _mm256_set1_epi16(GRAY_WEIGHT_B);
+
+    int i = 0;
+    for (; i + 16 <= pixels; i += 16) {
+        const uint8_t *p = rgb + (size_t)i * 3;
+        __m256i v0 = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)p)),
+                                             _mm_loadu_si128((const __m128i *)(p + 24)), 1);
+        __m256i v1 = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(p + 8))),
+                                             _mm_loadu_si128((const __m128i *)(p + 32)), 1);
+
+        __m256i r = _mm256_or_si256(_mm256_shuffle_epi8(v0, r_lo), _mm256_shuffle_epi8(v1, r_hi));
+        __m256i g = _mm256_or_si256(_mm256_shuffle_epi8(v0, g_lo), _mm256_shuffle_epi8(v1, g_hi));
+        __m256i b = _mm256_or_si256(_mm256_shuffle_epi8(v0, b_lo), _mm256_shuffle_epi8(v1, b_hi));
+
+        __m256i y = _mm256_add_epi16(_mm256_add_epi16(_mm256_mullo_epi16(r, wr), _mm256_mullo_epi16(g, wg)),
+                                     _mm256_mullo_epi16(b, wb));
+        y = _mm256_srli_epi16(y, 8);
+
+        // Packing works per lane; move the two 8-byte results next to each other
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(y, y), _MM_SHUFFLE(3, 1, 2, 0));
+        _mm_storeu_si128((__m128i *)(gray + i), _mm256_castsi256_si128(packed));
+    }
+
+    // Fewer than 16 pixels left, or the machine lacks SSSE3 (never with AVX2)
+    return i + gray_span_ssse3(rgb + (size_t)i * 3, gray + i, pixels - i);
+}
+
+__attribute__((target("avx2")))
+static int blur_col_step_avx2(uint16_t *sums, uint8_t *out, const uint8_t *add, const uint8_t *sub,
+                              int width, uint16_t reciprocal) {
+    const __m256i m = _mm256_set1_epi16((short)reciprocal);
+
+    int x = 0;
+    for (; x + 32 <= width; x += 32) {
+        __m256i lo = _mm256_loadu_si256((const __m256i *)(sums + x));
+        __m256i hi = _mm256_loadu_si256((const __m256i *)(sums + x + 16));
+        if (out) {
+            // Packing works per lane; put the four 8-byte groups back in order
+            __m256i packed = _mm256_packus_epi16(_mm256_mulhi_epu16(lo, m), _mm256_mulhi_epu16(hi, m));
+            _mm256_storeu_si256((__m256i *)(out + x), _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0)));
+        }
+        if (add) {
+            lo = _mm256_add_epi16(lo, _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(add + x))));
+            hi = _mm256_add_epi16(hi, _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(add + x + 16))));
+        }
+        if (sub) {
+            lo = _mm256_sub_epi16(lo, _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(sub + x))));
+            hi = _mm256_sub_epi16(hi, _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(sub + x + 16))));
+        }
+        _mm256_storeu_si256((__m256i *)(sums + x), lo);
+        _mm256_storeu_si256((__m256i *)(sums + x + 16), hi);
+    }
+
+    // Finish in blocks of 16
+    return x + blur_col_step_sse2(sums + x, out ? out + x : NULL, add ? add + x : NULL, sub ? sub + x : NULL,
+                                  width - x, reciprocal);
+}
+
+__attribute__((target("avx2")))
+static int diff_span_avx2(const uint8_t *cur, const uint8_t *prev, const uint8_t *bg, int count, int step,
+                          int threshold, uint32_t *sum, uint32_t *changed) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i ones = _mm256_set1_epi8(1);
+    const __m256i above = _mm256_set1_epi8((char)(threshold + 1));
+    const __m256i sampled = step == 2 ? _mm256_set1_epi16(0x00FF) : _mm256_set1_epi8(-1);
+    __m256i acc_sum = zero;
+    __m256i acc_changed = zero;
+
+    int i = 0;
+    for (; i + 32 <= count; i += 32) {
+        __m256i c = _mm256_loadu_si256((const __m256i *)(cur + i));
+        __m256i p = _mm256_loadu_si256((const __m256i *)(prev + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(bg + i));
+        __m256i cp = _mm256_or_si256(_mm256_subs_epu8(c, p), _mm256_subs_epu8(p, c));
+        __m256i cb = _mm256_or_si256(_mm256_subs_epu8(c, b), _mm256_subs_epu8(b, c));
+        __m256i d = _mm256_max_epu8(cp, cb);
+        __m256i mask = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(d, above), d), sampled);
+        acc_sum = _mm256_add_epi64(acc_sum, _mm256_sad_epu8(_mm256_and_si256(d, mask), zero));
+        acc_changed = _mm256_add_epi64(acc_changed, _mm256_sad_epu8(_mm256_and_si256(mask, ones), zero));
+    }
+
+    __m128i s = _mm_add_epi64(_mm256_castsi256_si128(acc_sum), _mm256_extracti128_si256(acc_sum, 1));
+    __m128i n = _mm_add_epi64(_mm256_castsi256_si128(acc_changed), _mm256_extracti128_si256(acc_changed, 1));
+    *sum += (uint32_t)_mm_cvtsi128_si32(s) + (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(s, 8));
+    *changed += (uint32_t)_mm_cvtsi128_si32(n) + (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(n, 8));
+
+    // Blocks of 32 keep the sampling phase, so the rest can go in blocks of 16
+    return i + diff_span_sse2(cur + i, prev + i, bg + i, count - i, step, threshold, sum, changed);
+}
+
+__attribute__((target("avx2")))
+static int blend_span_avx2(uint8_t *background, const uint8_t *current, int pixels, int alpha) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i a = _mm256_set1_epi16((short)alpha);
+    const __m256i inv_a = _mm256_set1_epi16((short)(256 - alpha));
+
+    int i = 0;
+    for (; i + 32 <= pixels; i += 32) {
+        __m256i b = _mm256_loadu_si256((const __m256i *)(background + i));
+        __m256i c = _mm256_loadu_si256((const __m256i *)(current + i));
+        __m256i lo = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(b, zero), inv_a),
+                                      _mm256_mullo_epi16(_mm256_unpacklo_epi8(c, zero), a));
+        __m256i hi = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(b, zero), inv_a),
+                                      _mm256_mullo_epi16(_mm256_unpackhi_epi8(c, zero), a));
+        _mm256_storeu_si256((__m256i *)(background + i),
+                            _mm256_packus_epi16(_mm256_srli_epi16(lo, 8), _mm256_srli_epi16(hi, 8)));
+    }
+    return i + blend_span_sse2(background + i, current + i, pixels - i, alpha);
+}
+
+#endif /* MOTION_KERNELS_X86 */
+
+#if MOTION_KERNELS_NEON
+
+/* NEON */
+
+static int gray_span_neon(const uint8_t *rgb, uint8_t *gray, int pixels) {
+    const uint8x8_t wr = vdup_n_u8(GRAY_WEIGHT_R);
+    const uint8x8_t wg = vdup_n_u8(GRAY_WEIGHT_G);
+    const uint8x8_t wb = vdup_n_u8(GRAY_WEIGHT_B);
+
+    int i = 0;
+    for (; i + 16 <= pixels; i += 16) {
+        uint8x16x3_t v = vld3q_u8(rgb + (size_t)i * 3);
+
+        uint16x8_t lo = vmull_u8(vget_low_u8(v.val[0]), wr);
+        lo = vmlal_u8(lo, vget_low_u8(v.val[1]), wg);
+        lo = vmlal_u8(lo, vget_low_u8(v.val[2]), wb);
+
+        uint16x8_t hi = vmull_u8(vget_high_u8(v.val[0]), wr);
+        hi = vmlal_u8(hi, vget_high_u8(v.val[1]), wg);
+        hi = vmlal_u8(hi, vget_high_u8(v.val[2]), wb);
+
+        vst1q_u8(gray + i, vcombine_u8(vshrn_n_u16(lo, 8), vshrn_n_u16(hi, 8)));
+    }
+    return i;
+}
+
+/**
+ * Divide 16-bit sums by the window size through its reciprocal
+ */
+static inline uint8x8_t divide_sums_neon(uint16x8_t sum, uint16x4_t m) {
+    uint16x4_t lo = vshrn_n_u32(vmull_u16(vget_low_u16(sum), m), 16);
+    uint16x4_t hi = vshrn_n_u32(vmull_u16(vget_high_u16(sum), m), 16);
+    return vmovn_u16(vcombine_u16(lo, hi));
+}
+
+static void prefix_sums_neon(const uint8_t *row, uint16_t *sums, int width) {
+    const uint16x8_t zero = vdupq_n_u16(0);
+    uint16_t total = 0;
+
+    sums[0] = 0;
+    int i = 0;
+    for (; i + 8 <= width; i += 8) {
+        uint16x8_t v = vmovl_u8(vld1_u8(row + i));
+        v = vaddq_u16(v, vextq_u16(zero, v, 7));
+        v = vaddq_u16(v, vextq_u16(zero, v, 6));
+        v = vaddq_u16(v, vextq_u16(zero, v, 4));
+        v = vaddq_u16(v, vdupq_n_u16(total));
+        vst1q_u16(sums + i + 1, v);
+        total = vgetq_lane_u16(v, 7);
+    }
+
+    for (; i < width; i++) {
+        total = (uint16_t)(total + row[i]);
+        sums[i + 1] = total;
+    }
+}
+
+static int blur_row_span_neon(const uint8_t *row, uint8_t *out, uint16_t *sums, int width, int radius,
+                              uint16_t reciprocal) {
+    const uint16x4_t m = vdup_n_u16(reciprocal);
+
+    prefix_sums_neon(row, sums, width);
+
+    int x = radius;
+    for (; x + 16 + radius <= width; x += 16) {
+        uint16x8_t lo = vsubq_u16(vld1q_u16(sums + x + radius + 1), vld1q_u16(sums + x - radius));
+        uint16x8_t hi = vsubq_u16(vld1q_u16(sums + x + radius + 9), vld1q_u16(sums + x - radius + 8));
+        vst1q_u8(out + x, vcombine_u8(divide_sums_neon(lo, m), divide_sums_neon(hi, m)));
+    }
+    return x;
+}
+
+static int blur_col_step_neon(uint16_t *sums, uint8_t *out, const uint8_t *add, const uint8_t *sub,
+                              int width, uint16_t reciprocal) {
+    const uint16x4_t m = vdup_n_u16(reciprocal);
+
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        uint16x8_t lo = vld1q_u16(sums + x);
+        uint16x8_t hi = vld1q_u16(sums + x + 8);
+        if (out) {
+            vst1q_u8(out + x, vcombine_u8(divide_sums_neon(lo, m), divide_sums_neon(hi, m)));
+        }
+        if (add) {
+            uint8x16_t v = vld1q_u8(add + x);
+            lo = vaddw_u8(lo, vget_low_u8(v));
+            hi = vaddw_u8(hi, vget_high_u8(v));
+        }
+        if (sub) {
+            uint8x16_t v = vld1q_u8(sub + x);
+            lo = vsubw_u8(lo, vget_low_u8(v));
+            hi = vsubw_u8(hi, vget_high_u8(v));
+        }
+        vst1q_u16(sums + x, lo);
+        vst1q_u16(sums + x + 8, hi);
+    }
+    return x;
+}
+
+static int downscale_span_neon(const uint8_t *src, int stride, int width, int factor, int y, uint8_t *out, int out_width) {
+    int x = 0;
+
+    if (factor == 2) {
+        const uint8_t *row0 = src + (size_t)(y * 2) * stride;
+        const uint8_t *row1 = row0 + stride;
+        for (; x + 8 <= out_width && x * 2 + 16 <= width; x += 8) {
+            uint16x8_t sum = vaddq_u16(vpaddlq_u8(vld1q_u8(row0 + x * 2)), vpaddlq_u8(vld1q_u8(row1 + x * 2)));
+            vst1_u8(out + x, vshrn_n_u16(sum, 2));
+        }
+    } else if (factor == 4) {
+        const uint8_t *row = src + (size_t)(y * 4) * stride;
+        for (; x + 4 <= out_width && x * 4 + 16 <= width; x += 4) {
+            uint32x4_t sum = vdupq_n_u32(0);
+            for (int dy = 0; dy < 4; dy++) {
+                sum = vaddq_u32(sum, vpaddlq_u16(vpaddlq_u8(vld1q_u8(row + (size_t)dy * stride + x * 4))));
+            }
+            uint16x4_t mean = vmovn_u32(vshrq_n_u32(sum, 4));
+            uint32_t value = vget_lane_u32(vreinterpret_u32_u8(vmovn_u16(vcombine_u16(mean, mean))), 0);
+            memcpy(out + x, &value, 4);
+        }
+    }
+    return x;
+}
+
+static int diff_span_neon(const uint8_t *cur, const uint8_t *prev, const uint8_t *bg, int count, int step,
+                          int threshold, uint32_t *sum, uint32_t *changed) {
+    const uint8x16_t limit = vdupq_n_u8((uint8_t)threshold);
+    const uint8x16_t ones = vdupq_n_u8(1);
+    const uint8x16_t sampled = step == 2 ? vreinterpretq_u8_u16(vdupq_n_u16(0x00FF)) : vdupq_n_u8(0xFF);
+    uint32x4_t acc_sum = vdupq_n_u32(0);
+    uint32x4_t acc_changed = vdupq_n_u32(0);
+
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        uint8x16_t c = vld1q_u8(cur + i);
+        uint8x16_t d = vmaxq_u8(vabdq_u8(c, vld1q_u8(prev + i)), vabdq_u8(c, vld1q_u8(bg + i)));
+        uint8x16_t mask = vandq_u8(vcgtq_u8(d, limit), sampled);
+        acc_sum = vpadalq_u16(acc_sum, vpaddlq_u8(vandq_u8(d, mask)));
+        acc_changed = vpadalq_u16(acc_changed, vpaddlq_u8(vandq_u8(mask, ones)));
+    }
+
+    uint64x2_t s = vpaddlq_u32(acc_sum);
+    uint64x2_t n = vpaddlq_u32(acc_changed);
+    *sum += (uint32_t)(vgetq_lane_u64(s, 0) + vgetq_lane_u64(s, 1));
+    *changed += (uint32_t)(vgetq_lane_u64(n, 0) + vgetq_lane_u64(n, 1));
+    return i;
+}
+
+static int blend_span_neon(uint8_t *background, const uint8_t *current, int pixels, int alpha) {
+    const uint16x8_t a = vdupq_n_u16((uint16_t)alpha);
+    const uint16x8_t inv_a = vdupq_n_u16((uint16_t)(256 - alpha));
+
+    int i = 0;
+    for (; i + 16 <= pixels; i += 16) {
+        uint8x16_t b = vld1q_u8(background + i);
+        uint8x16_t c = vld1q_u8(current + i);
+        uint16x8_t lo = vmlaq_u16(vmulq_u16(vmovl_u8(vget_low_u8(b)), inv_a), vmovl_u8(vget_low_u8(c)), a);
+        uint16x8_t hi = vmlaq_u16(vmulq_u16(vmovl_u8(vget_high_u8(b)), inv_a), vmovl_u8(vget_high_u8(c)), a);
+        vst1q_u8(background + i, vcombine_u8(vshrn_n_u16(lo, 8), vshrn_n_u16(hi, 8)));
+    }
+    return i;
+}
+
+#endif /* MOTION_KERNELS_NEON */
+
+// Instruction sets compiled in, widest first
+static const char *const kernel_isas[] = {
+#if MOTION_KERNELS_X86
+    "avx2", "ssse3", "sse2",
+#elif MOTION_KERNELS_NEON
+    "neon",
+#endif
+    "scalar",
+};
+
+/**
+ * Fill in the implementation for an instruction set
+ * Returns false when it is not compiled in or the CPU lacks it.
+ */
+static bool find_kernels(const char *isa, motion_kernels_t *out) {
+#if MOTION_KERNELS_X86
+    __builtin_cpu_init();
+    if (strcmp(isa, "avx2") == 0) {
+        if (!__builtin_cpu_supports("avx2")) {
+            return false;
+        }
+        *out = (motion_kernels_t){
+            .isa = "avx2",
+            .gray_span = gray_span_avx2,
+            .blur_row_span = blur_row_span_avx2,
+            .blur_col_step = blur_col_step_avx2,
+            .downscale_span = downscale_span_avx2,
+            .diff_span = diff_span_avx2,
+            .blend_span = blend_span_avx2,
+        };
+        return true;
+    }
+    if (strcmp(isa, "ssse3") == 0 || strcmp(isa, "sse2") == 0) {
+        // Only the RGB deinterleave needs SSSE3
+        bool ssse3 = strcmp(isa, "ssse3") == 0;
+        if (!__builtin_cpu_supports("sse2") || (ssse3 && !__builtin_cpu_supports("ssse3"))) {
+            return false;
+        }
+        *out = (motion_kernels_t){
+            .isa = ssse3 ? "ssse3" : "sse2",
+            .gray_span = ssse3 ? gray_span_ssse3 : NULL,
+            .blur_row_span = blur_row_span_sse2,
+            .blur_col_step = blur_col_step_sse2,
+            .downscale_span = downscale_span_sse2,
+            .diff_span = diff_span_sse2,
+            .blend_span = blend_span_sse2,
+        };
+        return true;
+    }
+#elif MOTION_KERNELS_NEON
+    // Advanced SIMD is part of every ARMv8-A core; 32-bit builds only get here with -mfpu=neon
+    if (strcmp(isa, "neon") == 0) {
+        *out = (motion_kernels_t){
+            .isa = "neon",
+            .gray_span = gray_span_neon,
+            .blur_row_span = blur_row_span_neon,
+            .blur_col_step = blur_col_step_neon,
+            .downscale_span = downscale_span_neon,
+            .diff_span = diff_span_neon,
+            .blend_span = blend_span_neon,
+        };
+        return true;
+    }
+#endif
+    if (strcmp(isa, "scalar") == 0) {
+        *out = (motion_kernels_t){ .isa = "scalar" };
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Pick the widest implementation the CPU supports
+ */
+static void select_kernels(void) {
+    for (size_t i = 0; i < sizeof(kernel_isas) / sizeof(kernel_isas[0]); i++) {
+        if (find_kernels(kernel_isas[i], &kernels)) {
+            break;
+        }
+    }
+
+    log_info("Motion detection kernels: %s", kernels.isa);
+}
+
+static inline const motion_kernels_t *get_kernels(void) {
+    pthread_once(&kernels_once, select_kernels);
+    return &kernels;
+}
+
+/**
+ * Reciprocal of a window size (2 to 16) for 16-bit division
+ */
+static inline uint16_t window_reciprocal(int count) {
+    return (uint16_t)((65536 + count - 1) / count);
+}
+
+const char *motion_kernels_isa(void) {
+    return get_kernels()->isa;
+}
+
+int motion_kernels_variants(const char **isas, int max) {
+    motion_kernels_t candidate;
+    int count = 0;
+    for (size_t i = 0; i < sizeof(kernel_isas) / sizeof(kernel_isas[0]) && count < max; i++) {
+        if (find_kernels(kernel_isas[i], &candidate)) {
+            isas[count++] = kernel_isas[i];
+        }
+    }
+    return count;
+}
+
+int motion_kernels_use(const char *isa) {
+    motion_kernels_t candidate;
+    // Make sure the one-time selection cannot overwrite the choice later
+    get_kernels();
+    if (!isa) {
+        select_kernels();
+        return 0;
+    }
+    if (!find_kernels(isa, &candidate)) {
+        return -1;
+    }
+    kernels = candidate;
+    return 0;
+}
+
+void motion_rgb_to_gray(const uint8_t *rgb, uint8_t *gray, int pixels) {
+    const motion_kernels_t *k = get_kernels();
+    int i = k->gray_span ? k->gray_span(rgb, gray, pixels) : 0;
+    for (; i < pixels; i++) {
+        gray[i] = gray_pixel(rgb + (size_t)i * 3);
+    }
+}
+
+void motion_downscale_gray(const uint8_t *src, int stride, int width, int height, int factor,
+                           uint8_t *dst, int out_width, int out_height) {
+    const motion_kernels_t *k = get_kernels();
+    for (int y = 0; y < out_height; y++) {
+        uint8_t *out = dst + (size_t)y * out_width;
+        int x = 0;
+
+        // Only rows whose blocks lie completely inside the source
+        if (k->downscale_span && (y + 1) * factor <= height) {
+            x = k->downscale_span(src, stride, width, factor, y, out, out_width);
+        }
+        for (; x < out_width; x++) {
+            out[x] = block_mean(src, stride, width, height, factor, x, y);
+        }
+    }
+}
+
+void motion_box_blur_rows(const uint8_t *src, uint8_t *dst, uint16_t *sums, int width, int height, int radius) {
+    const motion_kernels_t *k = get_kernels();
+    if (!k->blur_row_span || radius > MAX_VECTOR_RADIUS) {
+        blur_rows_scalar(src, dst, width, height, radius);
+        return;
+    }
+
+    uint16_t reciprocal = window_reciprocal(2 * radius + 1);
+    for (int y = 0; y < height; y++) {
+        const uint8_t *row = src + (size_t)y * width;
+        uint8_t *out = dst + (size_t)y * width;
+
+        int x = 0;
+        for (; x < radius && x < width; x++) {
+            out[x] = row_mean(row, width, x, radius);
+        }
+        if (x == radius) {
+            x = k->blur_row_span(row, out, sums, width, radius, reciprocal);
+        }
+        for (; x < width; x++) {
+            out[x] = row_mean(row, width, x, radius);
+        }
+    }
+}
+
+void motion_box_blur_cols(const uint8_t *src, uint8_t *dst, uint16_t *sums, int width, int height, int radius) {
+    const motion_kernels_t *k = get_kernels();
+    if (!k->blur_col_step || radius > MAX_VECTOR_RADIUS || height < 2) {
+        blur_cols_scalar(src, dst, width, height, radius);
+        return;
+    }
+
+    // Windows near the top and bottom hold fewer rows
+    uint16_t reciprocals[2 * MAX_VECTOR_RADIUS + 2];
+    for (int count = 2; count <= 2 * radius + 1; count++) {
+        reciprocals[count] = window_reciprocal(count);
+    }
+
+    // Column sums of the window of the first row
+    memset(sums, 0, (size_t)width * sizeof(uint16_t));
+    for (int i = 0; i <= radius && i < height; i++) {
+        const uint8_t *add = src + (size_t)i * width;
+        int x = k->blur_col_step(sums, NULL, add, NULL, width, 0);
+        for (; x < width; x++) {
+            sums[x] = (uint16_t)(sums[x] + add[x]);
+        }
+    }
+
+    // Emit each row, then slide the window down by one
+    for (int y = 0; y < height; y++) {
+        int first = y - radius < 0 ? 0 : y - radius;
+        int last = y + radius >= height ? height - 1 : y + radius;
+        int count = last - first + 1;
+        uint8_t *out = dst + (size_t)y * width;
+        const uint8_t *add = y + radius + 1 < height ? src + (size_t)(y + radius + 1) * width : NULL;
+        const uint8_t *sub = y - radius >= 0 ? src + (size_t)(y - radius) * width : NULL;
+
+        int x = k->blur_col_step(sums, out, add, sub, width, reciprocals[count]);
+        for (; x < width; x++) {
+            out[x] = (uint8_t)(sums[x] / count);
+            sums[x] = (uint16_t)(sums[x] + (add ? add[x] : 0) - (sub ? sub[x] : 0));
+        }
+    }
+}
+
+void motion_diff_sum(const uint8_t *cur, const uint8_t *prev, const uint8_t *bg, int count, int step,
+                     int threshold, uint32_t *sum, uint32_t *changed) {
+    // No difference can exceed 255
+    if (threshold >= 255 || count <= 0) {
+        return;
+    }
+
+    // The vector compare needs threshold + 1 to fit in a byte
+    const motion_kernels_t *k = get_kernels();
+    int i = 0;
+    if (k->diff_span && threshold >= 0) {
+        i = k->diff_span(cur, prev, bg, count, step, threshold, sum, changed);
+    }
+    for (; i < count; i += step) {
+        int diff = pixel_diff(cur[i], prev[i], bg[i]);
+        if (diff > threshold) {
+            *sum += (uint32_t)diff;
+            (*changed)++;
+        }
+    }
+}
+
+void motion_blend_background(uint8_t *background, const uint8_t *current, int pixels, int alpha) {
+    const motion_kernels_t *k = get_kernels();
+    int inv_alpha = 256 - alpha;
+    int i = k->blend_span ? k->blend_span(background, current, pixels, alpha) : 0;
+    for (; i < pixels; i++) {
+        background[i] = (uint8_t)((inv_alpha * background[i] + alpha * current[i]) >> 8);
+    }
+}
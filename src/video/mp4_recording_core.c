@@ -31,11 +31,15 @@
 #include "video/stream_manager.h"
 #include "video/streams.h"
 #include "video/mp4_writer.h"
+#include "video/mp4_standby.h"
 #include "video/mp4_recording.h"
 #include "video/mp4_recording_internal.h"
+#include "video/hls_recording.h"
 #include "video/mp4_writer_thread.h"
 #include "video/mp4_segment_recorder.h"
 #include "video/stream_packet_processor.h"
+#include "video/thread_utils.h"
+#include "storage/storage_manager.h"
 
 
 // Hash map for tracking running MP4 recording contexts
@@ -64,6 +68,7 @@ static void *mp4_recording_thread(void *arg) {
     char stream_name[MAX_STREAM_NAME];
     strncpy(stream_name, ctx->config.name, MAX_STREAM_NAME - 1);
     stream_name[MAX_STREAM_NAME - 1] = '\0';
+    thread_set_identity(THREAD_CLASS_RECORDING, "rec", stream_name);
 
     log_info("Starting MP4 recording thread for stream %s", stream_name);
 
@@ -350,6 +355,12 @@ int start_mp4_recording(const char *stream_name) {
         return -1;
     }
 
+    // The HLS writer records this stream from its segments
+    if (hls_recording_applies(&config)) {
+        log_info("Stream %s records its HLS segments, not starting MP4 recording", stream_name);
+        return 0;
+    }
+
     // Check if already running
     for (int i = 0; i < MAX_STREAMS; i++) {
         if (recording_contexts[i] && strcmp(recording_contexts[i]->config.name, stream_name) == 0) {
@@ -390,11 +401,8 @@ int start_mp4_recording(const char *stream_name) {
     // Create output paths
     config_t *global_config = get_streaming_config();
 
-    // Create timestamp for MP4 filename
-    char timestamp_str[32];
+    // Start time of the first MP4 file
     time_t now = time(NULL);
-    struct tm *tm_info = localtime(&now);
-    strftime(timestamp_str, sizeof(timestamp_str), "%Y%m%d_%H%M%S", tm_info);
 
     // Create MP4 directory path
     char mp4_dir[MAX_PATH_LENGTH];
@@ -408,52 +416,60 @@ int start_mp4_recording(const char *stream_name) {
                 global_config->storage_path, stream_name);
     }
 
-    // Create MP4 directory if it doesn't exist
-    char dir_cmd[MAX_PATH_LENGTH * 2];
-    snprintf(dir_cmd, sizeof(dir_cmd), "mkdir -p %s", mp4_dir);
-    int ret = system(dir_cmd);
-    if (ret != 0) {
-        log_error("Failed to create MP4 directory: %s (return code: %d)", mp4_dir, ret);
+    // A stream on standby for detection has its directory, and the shell commands
+    // would only delay the recording
+    mp4_standby_triggered(stream_name);
+    if (!mp4_standby_ready(stream_name)) {
+        // Create MP4 directory if it doesn't exist
+        char dir_cmd[MAX_PATH_LENGTH * 2];
+        snprintf(dir_cmd, sizeof(dir_cmd), "mkdir -p %s", mp4_dir);
+        int ret = system(dir_cmd);
+        if (ret != 0) {
+            log_error("Failed to create MP4 directory: %s (return code: %d)", mp4_dir, ret);
 
-        // Try to create the parent directory first
-        char parent_dir[MAX_PATH_LENGTH];
-        if (global_config->record_mp4_directly && global_config->mp4_storage_path[0] != '\0') {
-            strncpy(parent_dir, global_config->mp4_storage_path, MAX_PATH_LENGTH - 1);
-        } else {
-            snprintf(parent_dir, MAX_PATH_LENGTH, "%s/mp4", global_config->storage_path);
-        }
+            // Try to create the parent directory first
+            char parent_dir[MAX_PATH_LENGTH];
+            if (global_config->record_mp4_directly && global_config->mp4_storage_path[0] != '\0') {
+                strncpy(parent_dir, global_config->mp4_storage_path, MAX_PATH_LENGTH - 1);
+            } else {
+                snprintf(parent_dir, MAX_PATH_LENGTH, "%s/mp4", global_config->storage_path);
+            }
 
-        snprintf(dir_cmd, sizeof(dir_cmd), "mkdir -p %s", parent_dir);
-        ret = system(dir_cmd);
-        if (ret != 0) {
-            log_error("Failed to create parent MP4 directory: %s (return code: %d)", parent_dir, ret);
-            free(ctx);
-            return -1;
+            snprintf(dir_cmd, sizeof(dir_cmd), "mkdir -p %s", parent_dir);
+            ret = system(dir_cmd);
+            if (ret != 0) {
+                log_error("Failed to create parent MP4 directory: %s (return code: %d)", parent_dir, ret);
+                free(ctx);
+                return -1;
+            }
+
+            // Try again to create the stream-specific directory
+            snprintf(dir_cmd, sizeof(dir_cmd), "mkdir -p %s", mp4_dir);
+            ret = system(dir_cmd);
+            if (ret != 0) {
+                log_error("Still failed to create MP4 directory: %s (return code: %d)", mp4_dir, ret);
+                free(ctx);
+                return -1;
+            }
         }
 
-        // Try again to create the stream-specific directory
-        snprintf(dir_cmd, sizeof(dir_cmd), "mkdir -p %s", mp4_dir);
-        ret = system(dir_cmd);
-        if (ret != 0) {
-            log_error("Still failed to create MP4 directory: %s (return code: %d)", mp4_dir, ret);
-            free(ctx);
-            return -1;
+        // Set full permissions for MP4 directory
+        snprintf(dir_cmd, sizeof(dir_cmd), "chmod -R 777 %s", mp4_dir);
+        int ret_chmod = system(dir_cmd);
+        if (ret_chmod != 0) {
+            log_warn("Failed to set permissions on MP4 directory: %s (return code: %d)", mp4_dir, ret_chmod);
         }
     }
 
-    // Set full permissions for MP4 directory
-    snprintf(dir_cmd, sizeof(dir_cmd), "chmod -R 777 %s", mp4_dir);
-    int ret_chmod = system(dir_cmd);
-    if (ret_chmod != 0) {
-        log_warn("Failed to set permissions on MP4 directory: %s (return code: %d)", mp4_dir, ret_chmod);
+    // Full path for the MP4 file, in the directory of the hour with shard_recordings
+    if (get_recording_path(stream_name, now, ctx->output_path, MAX_PATH_LENGTH) != 0) {
+        log_error("Failed to create recording path for %s", stream_name);
+        free(ctx);
+        return -1;
     }
 
-    // Full path for the MP4 file
-    snprintf(ctx->output_path, MAX_PATH_LENGTH, "%s/recording_%s.mp4",
-             mp4_dir, timestamp_str);
-
     // Start recording thread
-    if (pthread_create(&ctx->thread, NULL, mp4_recording_thread, ctx) != 0) {
+    if (pthread_create_with_stack(&ctx->thread, mp4_recording_thread, ctx, STREAM_THREAD_STACK_SIZE, false) != 0) {
         free(ctx);
         log_error("Failed to create MP4 recording thread for %s", stream_name);
         return -1;
@@ -489,6 +505,12 @@ int start_mp4_recording_with_url(const char *stream_name, const char *url) {
         return -1;
     }
 
+    // The HLS writer records this stream from its segments
+    if (hls_recording_applies(&config)) {
+        log_info("Stream %s records its HLS segments, not starting MP4 recording", stream_name);
+        return 0;
+    }
+
     // Check if already running
     for (int i = 0; i < MAX_STREAMS; i++) {
         if (recording_contexts[i] && strcmp(recording_contexts[i]->config.name, stream_name) == 0) {
@@ -532,11 +554,8 @@ int start_mp4_recording_with_url(const char *stream_name, const char *url) {
     // Create output paths
     config_t *global_config = get_streaming_config();
 
-    // Create timestamp for MP4 filename
-    char timestamp_str[32];
+    // Start time of the first MP4 file
     time_t now = time(NULL);
-    struct tm *tm_info = localtime(&now);
-    strftime(timestamp_str, sizeof(timestamp_str), "%Y%m%d_%H%M%S", tm_info);
 
     // Create MP4 directory path
     char mp4_dir[MAX_PATH_LENGTH];
@@ -590,12 +609,15 @@ int start_mp4_recording_with_url(const char *stream_name, const char *url) {
         log_warn("Failed to set permissions on MP4 directory: %s (return code: %d)", mp4_dir, ret_chmod);
     }
 
-    // Full path for the MP4 file
-    snprintf(ctx->output_path, MAX_PATH_LENGTH, "%s/recording_%s.mp4",
-             mp4_dir, timestamp_str);
+    // Full path for the MP4 file, in the directory of the hour with shard_recordings
+    if (get_recording_path(stream_name, now, ctx->output_path, MAX_PATH_LENGTH) != 0) {
+        log_error("Failed to create recording path for %s", stream_name);
+        free(ctx);
+        return -1;
+    }
 
     // Start recording thread
-    if (pthread_create(&ctx->thread, NULL, mp4_recording_thread, ctx) != 0) {
+    if (pthread_create_with_stack(&ctx->thread, mp4_recording_thread, ctx, STREAM_THREAD_STACK_SIZE, false) != 0) {
         free(ctx);
         log_error("Failed to create MP4 recording thread for %s", stream_name);
         return -1;
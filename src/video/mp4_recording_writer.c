@@ -173,6 +173,12 @@ void unregister_mp4_writer_for_stream(const char *stream_name) {
     }
 }
 
+// Finalize one MP4 writer, run in parallel by close_all_mp4_writers
+static void *close_writer_thread(void *arg) {
+    mp4_writer_close((mp4_writer_t *)arg);
+    return NULL;
+}
+
 /**
  * Close all MP4 writers during shutdown
  * 
@@ -232,16 +238,12 @@ void close_all_mp4_writers(void) {
         }
     }
 
-    // Now close each writer
+    // Update recording contexts to prevent double-free
     for (int i = 0; i < num_writers_to_close; i++) {
-        log_info("Finalizing MP4 recording for stream: %s", stream_names_to_close[i]);
-        
-        // Log before closing
         log_info("Closing MP4 writer for stream %s at %s", 
                 stream_names_to_close[i], 
                 file_paths_to_close[i][0] != '\0' ? file_paths_to_close[i] : "(empty path)");
-        
-        // Update recording contexts to prevent double-free
+
         for (int j = 0; j < MAX_STREAMS; j++) {
             if (recording_contexts[j] && 
                 strcmp(recording_contexts[j]->config.name, stream_names_to_close[i]) == 0) {
@@ -254,13 +256,25 @@ void close_all_mp4_writers(void) {
                 }
             }
         }
+    }
 
-        // Close the MP4 writer to finalize the file
-        if (writers_to_close[i] != NULL) {
+    // Finalize the files in parallel, each close waits for its writer thread to drain
+    pthread_t close_threads[MAX_STREAMS];
+    bool close_started[MAX_STREAMS] = {false};
+    for (int i = 0; i < num_writers_to_close; i++) {
+        close_started[i] = pthread_create(&close_threads[i], NULL, close_writer_thread,
+                                          writers_to_close[i]) == 0;
+        if (!close_started[i]) {
             mp4_writer_close(writers_to_close[i]);
-            writers_to_close[i] = NULL; // Set to NULL to prevent any accidental use after free
         }
-        
+    }
+
+    for (int i = 0; i < num_writers_to_close; i++) {
+        if (close_started[i]) {
+            pthread_join(close_threads[i], NULL);
+        }
+        writers_to_close[i] = NULL; // Set to NULL to prevent any accidental use after free
+
         // Update the database to mark the recording as complete
         if (file_paths_to_close[i][0] != '\0') {
             // Add an event to the database
@@ -0,0 +1,170 @@
+#define _FILE_OFFSET_BITS 64
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "core/logger.h"
+#include "database/db_recordings.h"
+#include "video/mp4_recovery.h"
+#include "video/hls_recording.h"
+#include "video/recording_index.h"
+
+// Most interrupted recordings finalized in one startup
+#define MP4_RECOVERY_MAX_RECORDINGS 256
+
+/**
+ * Read a big-endian integer
+ */
+static uint64_t read_be(const uint8_t *data, int bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++) {
+        value = (value << 8) | data[i];
+    }
+    return value;
+}
+
+/**
+ * Truncate a fragmented MP4 file after its last complete fragment
+ */
+int mp4_recovery_finalize_file(const char *path, uint64_t *size) {
+    struct stat st;
+    if (!path || stat(path, &st) != 0) {
+        return -1;
+    }
+
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        log_warn("Failed to open %s for recovery: %s", path, strerror(errno));
+        return -1;
+    }
+
+    off_t file_size = st.st_size;
+    off_t offset = 0;
+    off_t good_end = 0;             // End of the last box the file can be cut after
+    bool has_moov = false;
+    bool in_fragment = false;       // A moof was read and its mdat is still missing
+    int fragments = 0;
+
+    while (offset + 8 <= file_size) {
+        uint8_t header[16];
+        if (fseeko(file, offset, SEEK_SET) != 0 || fread(header, 1, 8, file) != 8) {
+            break;
+        }
+
+        uint64_t box_size = read_be(header, 4);
+        uint64_t header_size = 8;
+        if (box_size == 1) {
+            if (fread(header + 8, 1, 8, file) != 8) {
+                break;
+            }
+            box_size = read_be(header + 8, 8);
+            header_size = 16;
+        }
+
+        // A box running to the end of the file (size 0) was never finished
+        if (box_size < header_size || box_size > (uint64_t)(file_size - offset)) {
+            break;
+        }
+
+        off_t box_end = offset + (off_t)box_size;
+        if (memcmp(header + 4, "moof", 4) == 0) {
+            in_fragment = true;
+        } else if (memcmp(header + 4, "mdat", 4) == 0) {
+            if (in_fragment) {
+                fragments++;
+                in_fragment = false;
+            }
+            good_end = box_end;
+        } else {
+            if (memcmp(header + 4, "moov", 4) == 0) {
+                has_moov = true;
+            }
+            if (!in_fragment) {
+                good_end = box_end;
+            }
+        }
+
+        offset = box_end;
+    }
+
+    fclose(file);
+
+    if (!has_moov || fragments == 0) {
+        log_info("Recording %s has no complete fragment, leaving it for a full rebuild", path);
+        return -1;
+    }
+
+    if (good_end < file_size) {
+        if (truncate(path, good_end) != 0) {
+            log_warn("Failed to truncate %s: %s", path, strerror(errno));
+            return -1;
+        }
+        log_info("Truncated interrupted recording %s from %lld to %lld bytes",
+                path, (long long)file_size, (long long)good_end);
+    }
+
+    if (size) {
+        *size = (uint64_t)good_end;
+    }
+    return 0;
+}
+
+/**
+ * Finalize the recordings left incomplete in the database by the last run
+ */
+int mp4_recovery_finalize_incomplete(void) {
+    recording_metadata_t *recordings = calloc(MP4_RECOVERY_MAX_RECORDINGS, sizeof(recording_metadata_t));
+    if (!recordings) {
+        log_error("Failed to allocate memory for recording recovery");
+        return 0;
+    }
+
+    int count = get_incomplete_recordings(recordings, MP4_RECOVERY_MAX_RECORDINGS);
+    int finalized = 0;
+
+    for (int i = 0; i < count; i++) {
+        const recording_metadata_t *recording = &recordings[i];
+
+        // Recordings of HLS segments end with their last segment indexed
+        if (hls_recording_is_segmented(recording->file_path)) {
+            if (hls_recording_finalize(recording) == 0) {
+                finalized++;
+            }
+            continue;
+        }
+
+        const char *ext = strrchr(recording->file_path, '.');
+        if (!ext || strcmp(ext, ".mp4") != 0) {
+            continue;
+        }
+
+        // The last write is at most one fragment before the interruption
+        struct stat st;
+        if (stat(recording->file_path, &st) != 0) {
+            continue;
+        }
+        time_t end_time = st.st_mtime > recording->start_time ? st.st_mtime : recording->start_time;
+
+        uint64_t size = 0;
+        if (mp4_recovery_finalize_file(recording->file_path, &size) != 0) {
+            continue;
+        }
+
+        if (update_recording_metadata(recording->id, end_time, size, true) == 0) {
+            finalized++;
+        }
+        recording_index_build(recording->file_path);
+    }
+
+    if (finalized > 0) {
+        log_info("Finalized %d of %d interrupted recordings", finalized, count);
+    }
+
+    free(recordings);
+    return finalized;
+}
@@ -27,10 +27,19 @@
 #include <libavutil/mathematics.h>
 
 #include "core/logger.h"
+#include "core/config.h"
 #include "core/shutdown_coordinator.h"
+#include "core/metrics.h"
 #include "video/mp4_writer.h"
 #include "video/mp4_writer_internal.h"
 #include "video/mp4_segment_recorder.h"
+#include "video/stream_ingest.h"
+#include "video/mp4_standby.h"
+#include "storage/storage_io.h"
+
+// Longest fragment of a fragmented MP4 recording, in microseconds; also bounds
+// how much of a recording a power loss can take
+#define MP4_FRAGMENT_DURATION_US "2000000"
 
 // Note: We can't directly access internal FFmpeg structures
 // So we'll use the public API for cleanup
@@ -88,14 +97,24 @@ void mp4_segment_recorder_init(void) {
  * - Timestamp errors: The function uses a robust timestamp handling approach to
  *   prevent floating point errors and timestamp inflation.
  *
- * @param rtsp_url The URL of the RTSP stream to record
+ * @param rtsp_url The URL of the RTSP stream to record (unused with a persistent input)
+ * @param input Persistent input kept open across segments, or NULL for one-shot recording
  * @param output_file The path to the output MP4 file
  * @param duration The duration to record in seconds
  * @param has_audio Flag indicating whether to include audio in the recording
+ * @param boundary Filled with the segment boundaries on success (may be NULL)
  * @return 0 on success, negative value on error
  */
-int record_segment(const char *rtsp_url, const char *output_file, int duration, int has_audio) {
+static int record_segment_internal(const char *rtsp_url, mp4_segment_input_t *input,
+                                   const char *output_file, int duration, int has_audio,
+                                   mp4_segment_boundary_t *boundary) {
     int ret = 0;
+    stream_ingest_consumer_t *consumer = input ? input->consumer : NULL;
+    // Persistent inputs carry their own continuity info so streams don't share it
+    segment_info_t *info = input ? &input->info : &segment_info;
+    time_t segment_start_wall = 0;
+    bool carried_keyframe = false;
+    bool input_failed = false;  // Reading from the input failed; don't keep it for the next segment
     AVFormatContext *input_ctx = NULL;
     AVFormatContext *output_ctx = NULL;
     AVDictionary *opts = NULL;
@@ -127,18 +146,39 @@ int record_segment(const char *rtsp_url, const char *output_file, int duration,
 
     // Thread-safe access to static segment info
     pthread_mutex_lock(&static_vars_mutex);
-    segment_index = segment_info.segment_index + 1;
+    segment_index = info->segment_index + 1;
     pthread_mutex_unlock(&static_vars_mutex);
 
     log_info("Starting new segment with index %d", segment_index);
 
-    log_info("Recording from %s", rtsp_url);
+    if (input && !consumer) {
+        rtsp_url = input->url;
+    }
+    log_info("Recording from %s", consumer ? "shared ingest" : rtsp_url);
     log_info("Output file: %s", output_file);
     log_info("Duration: %d seconds", duration);
 
     // Thread-safe access to static input context
     pthread_mutex_lock(&static_vars_mutex);
-    if (static_input_ctx) {
+    if (consumer) {
+        pthread_mutex_unlock(&static_vars_mutex);
+
+        // The shared ingest owns the connection; we only need its stream description
+        ret = stream_ingest_wait_for_streams(consumer, 10000);
+        if (ret < 0) {
+            log_error("Shared ingest has no streams available for %s", output_file);
+            goto cleanup;
+        }
+        input_ctx = stream_ingest_get_format_context(consumer);
+        log_debug("Using shared ingest input");
+    } else if (input && input->input_ctx) {
+        pthread_mutex_unlock(&static_vars_mutex);
+
+        // The connection stays open between segments; only the output is rotated
+        input_ctx = input->input_ctx;
+        input->input_ctx = NULL;
+        log_debug("Using persistent input context");
+    } else if (!input && static_input_ctx) {
         input_ctx = static_input_ctx;
         // Clear the static pointer to prevent double free
         static_input_ctx = NULL;
@@ -184,7 +224,7 @@ int record_segment(const char *rtsp_url, const char *output_file, int duration,
         goto cleanup;
     }
 
-    log_debug("Input format: %s", input_ctx->iformat->name);
+    log_debug("Input format: %s", input_ctx->iformat ? input_ctx->iformat->name : "shared ingest");
     log_debug("Number of streams: %d", input_ctx->nb_streams);
 
     // Find video and audio streams
@@ -228,6 +268,18 @@ int record_segment(const char *rtsp_url, const char *output_file, int duration,
         goto cleanup;
     }
 
+    // The first segment of a detection-triggered recording continues the stream's standby output,
+    // which has its file created and header written already
+    if (input && input->stream_name[0] != '\0' && info->segment_index == 0) {
+        output_ctx = mp4_standby_take(input->stream_name, output_file, input_ctx, video_stream_idx,
+                                      (has_audio && audio_stream_idx >= 0) ? audio_stream_idx : -1);
+        if (output_ctx) {
+            out_video_stream = output_ctx->streams[0];
+            out_audio_stream = output_ctx->nb_streams > 1 ? output_ctx->streams[1] : NULL;
+            goto output_ready;
+        }
+    }
+
     // Create output context
     ret = avformat_alloc_output_context2(&output_ctx, NULL, "mp4", output_file);
     if (ret < 0 || !output_ctx) {
@@ -290,13 +342,15 @@ int record_segment(const char *rtsp_url, const char *output_file, int duration,
         out_audio_stream->time_base = input_ctx->streams[audio_stream_idx]->time_base;
     }
 
-    // CRITICAL FIX: Disable faststart to prevent segmentation faults
-    // The faststart option causes a second pass that moves the moov atom to the beginning of the file
-    // This second pass is causing segmentation faults during shutdown
-    av_dict_set(&out_opts, "movflags", "empty_moov", 0);
+    mp4_segment_output_options(&out_opts);
 
-    // Open output file
-    ret = avio_open(&output_ctx->pb, output_file, AVIO_FLAG_WRITE);
+    // Open output file; the storage I/O thread does the writes, so a slow disk does not stall
+    // the recording, and the file is preallocated to the size of the previous segment
+    int64_t expected_size = info->last_segment_size + info->last_segment_size / 8;
+    ret = storage_io_open_avio(&output_ctx->pb, output_file, expected_size);
+    if (ret < 0) {
+        ret = avio_open(&output_ctx->pb, output_file, AVIO_FLAG_WRITE);
+    }
     if (ret < 0) {
         log_error("Failed to open output file: %d", ret);
         goto cleanup;
@@ -349,6 +403,11 @@ int record_segment(const char *rtsp_url, const char *output_file, int duration,
         goto cleanup;
     }
 
+output_ready:
+    if (input && input->stream_name[0] != '\0') {
+        mp4_standby_output_ready(input->stream_name);
+    }
+
     // Initialize packet - ensure it's properly allocated and initialized
     pkt = av_packet_alloc();
     if (!pkt) {
@@ -410,14 +469,28 @@ int record_segment(const char *rtsp_url, const char *output_file, int duration,
             }
         }
 
-        // Read packet
-        ret = av_read_frame(input_ctx, pkt);
+        // Read packet, starting with the keyframe that ended the previous segment
+        if (input && input->carry_pkt && input->carry_pkt->size > 0) {
+            av_packet_move_ref(pkt, input->carry_pkt);
+            carried_keyframe = true;
+            ret = 0;
+        } else if (consumer) {
+            ret = stream_ingest_read_packet(consumer, pkt, 100);
+        } else {
+            ret = av_read_frame(input_ctx, pkt);
+        }
         if (ret < 0) {
             if (ret == AVERROR_EOF) {
                 log_info("End of stream reached");
+                input_failed = true;
+                break;
+            } else if (ret == STREAM_INGEST_STREAMS_CHANGED) {
+                // The ingest reconnected; finish this file and start the next with the new streams
+                log_info("Input streams changed, ending segment");
                 break;
             } else if (ret != AVERROR(EAGAIN)) {
                 log_error("Error reading frame: %d", ret);
+                input_failed = true;
                 break;
             }
             // EAGAIN means try again, so we continue
@@ -439,9 +512,12 @@ int record_segment(const char *rtsp_url, const char *output_file, int duration,
 
                     // Reset start time to when we found the first key frame
                     start_time = av_gettime();
+                    segment_start_wall = time(NULL);
 
                     // Note if we had a keyframe at the end of the previous segment
-                    if (segment_info.last_frame_was_key && segment_index > 0) {
+                    if (carried_keyframe) {
+                        log_info("Starting segment with the key frame that ended the previous segment");
+                    } else if (info->last_frame_was_key && segment_index > 0) {
                         log_info("Previous segment ended with a key frame, and we're starting with a new keyframe");
                     }
                 } else {
@@ -467,15 +543,22 @@ int record_segment(const char *rtsp_url, const char *output_file, int duration,
                 // If this is a key frame or we've waited too long (more than 1 second)
                 // Reduced from 2 to 1 second to improve segment length precision
                 if (is_keyframe || wait_time > 1) {
-                    if (is_keyframe) {
+                    if (is_keyframe && input && input->carry_pkt) {
+                        // Keep the key frame for the next segment instead of writing it here,
+                        // so the next file starts without waiting for another GOP
+                        log_info("Found final key frame, ending recording and carrying it over");
+                        info->last_frame_was_key = true;
+                        av_packet_move_ref(input->carry_pkt, pkt);
+                        break;
+                    } else if (is_keyframe) {
                         log_info("Found final key frame, ending recording");
                         // Set flag to indicate the last frame was a key frame
-                        segment_info.last_frame_was_key = true;
+                        info->last_frame_was_key = true;
                         log_debug("Last frame was a key frame, next segment will start immediately with this keyframe");
                     } else {
                         log_info("Waited %lld seconds for key frame, ending recording with non-key frame", (long long)wait_time);
                         // Clear flag since the last frame was not a key frame
-                        segment_info.last_frame_was_key = false;
+                        info->last_frame_was_key = false;
                         log_debug("Last frame was NOT a key frame, next segment will wait for a keyframe");
                     }
 
@@ -984,12 +1067,26 @@ int record_segment(const char *rtsp_url, const char *output_file, int duration,
 
     // Thread-safe update of segment info for the next segment
     pthread_mutex_lock(&static_vars_mutex);
-    segment_info.segment_index = segment_index;
-    segment_info.has_audio = has_audio && audio_stream_idx >= 0;
+    info->segment_index = segment_index;
+    info->has_audio = has_audio && audio_stream_idx >= 0;
     pthread_mutex_unlock(&static_vars_mutex);
 
     log_info("Saved segment info for next segment: index=%d, has_audio=%d, last_frame_was_key=%d",
-            segment_index, has_audio && audio_stream_idx >= 0, segment_info.last_frame_was_key);
+            segment_index, has_audio && audio_stream_idx >= 0, info->last_frame_was_key);
+
+    // Report where this segment starts and ends so the caller can rotate metadata
+    if (boundary && ret >= 0) {
+        boundary->start_time = segment_start_wall ? segment_start_wall : time(NULL);
+        boundary->end_time = time(NULL);
+        boundary->duration_ms = 0;
+        if (first_video_dts != AV_NOPTS_VALUE) {
+            boundary->duration_ms = av_rescale_q(last_video_dts, input_ctx->streams[video_stream_idx]->time_base,
+                                                 (AVRational){1, 1000});
+        }
+        boundary->video_packets = video_packet_count;
+        boundary->audio_packets = audio_packet_count;
+        boundary->ended_on_keyframe = info->last_frame_was_key;
+    }
 
 cleanup:
     // CRITICAL FIX: Aggressive cleanup to prevent memory growth over time
@@ -1030,7 +1127,13 @@ cleanup:
         }
 
         // Close output file if it was opened
-        if (output_ctx->pb) {
+        if (output_ctx->pb && storage_io_is_avio(output_ctx->pb)) {
+            log_debug("Closing output file");
+            int64_t size = storage_io_close_avio(&output_ctx->pb);
+            if (size > 0) {
+                info->last_segment_size = size;
+            }
+        } else if (output_ctx->pb) {
             log_debug("Closing output file");
             avio_closep(&output_ctx->pb);
         }
@@ -1058,8 +1161,18 @@ cleanup:
     // CRITICAL FIX: Properly handle the input context to prevent memory leaks
     log_debug("Handling input context cleanup");
 
+    // The shared ingest's shadow context is never closed or cached here
+    if (consumer) {
+        input_ctx = NULL;
+    }
+    // Keep a persistent input open for the next segment
+    else if (input && ret >= 0 && !input_failed) {
+        input->input_ctx = input_ctx;
+        input_ctx = NULL;
+        log_debug("Keeping input context open for next segment");
+    }
     // Store the input context for reuse if recording was successful
-    if (ret >= 0) {
+    else if (!input && ret >= 0) {
         pthread_mutex_lock(&static_vars_mutex);
         // Only store if there's no existing context (should never happen, but just in case)
         if (static_input_ctx == NULL) {
@@ -1074,16 +1187,6 @@ cleanup:
             // This should never happen, but if it does, close the current context
             log_warn("Static input context already exists, closing current context");
 
-            // Clean up all streams before closing
-            for (unsigned int i = 0; i < input_ctx->nb_streams; i++) {
-                if (input_ctx->streams[i]) {
-                    // Free any codec parameters
-                    if (input_ctx->streams[i]->codecpar) {
-                        avcodec_parameters_free(&input_ctx->streams[i]->codecpar);
-                    }
-                }
-            }
-
             avformat_close_input(&input_ctx);
         }
         pthread_mutex_unlock(&static_vars_mutex);
@@ -1095,20 +1198,6 @@ cleanup:
         // CRITICAL FIX: Check if input_ctx is NULL before trying to access it
         // This prevents segmentation fault when RTSP connection fails
         if (input_ctx) {
-            // CRITICAL FIX: Use a safer approach to clean up FFmpeg resources
-            // First check if the context is valid and has streams
-            if (input_ctx->nb_streams > 0) {
-                // Clean up all streams before closing
-                for (unsigned int i = 0; i < input_ctx->nb_streams; i++) {
-                    if (input_ctx->streams && input_ctx->streams[i]) {
-                        // Free any codec parameters
-                        if (input_ctx->streams[i]->codecpar) {
-                            avcodec_parameters_free(&input_ctx->streams[i]->codecpar);
-                        }
-                    }
-                }
-            }
-
             // Flush any pending data
             if (input_ctx->pb) {
                 avio_flush(input_ctx->pb);
@@ -1121,16 +1210,109 @@ cleanup:
             log_debug("Input context is NULL, nothing to clean up");
         }
         log_debug("Closed input context due to error");
+
+        // A carried key frame belongs to the connection that was just closed
+        if (input && input->carry_pkt) {
+            av_packet_unref(input->carry_pkt);
+        }
     }
 
     // Final FFmpeg cleanup to prevent memory leaks
-    avformat_network_deinit();
+    // Persistent and shared inputs keep the network layer in use, so leave it initialized
+    if (!input) {
+        avformat_network_deinit();
+    }
     av_dict_free(&opts);
 
     // Return the error code
     return ret;
 }
 
+/**
+ * Record an RTSP stream to an MP4 file for a specified duration
+ */
+int record_segment(const char *rtsp_url, const char *output_file, int duration, int has_audio) {
+    return record_segment_internal(rtsp_url, NULL, output_file, duration, has_audio, NULL);
+}
+
+/**
+ * Set the muxer options of an MP4 recording
+ */
+void mp4_segment_output_options(AVDictionary **opts) {
+    // CRITICAL FIX: Disable faststart to prevent segmentation faults
+    // The faststart option causes a second pass that moves the moov atom to the beginning of the file
+    // This second pass is causing segmentation faults during shutdown
+    if (g_config.mp4_fragmented) {
+        // Every fragment is self-contained and written out as soon as it is cut, so
+        // an interrupted file stays playable up to its last complete fragment
+        av_dict_set(opts, "movflags", "frag_keyframe+empty_moov+default_base_moof", 0);
+        av_dict_set(opts, "frag_duration", MP4_FRAGMENT_DURATION_US, 0);
+        av_dict_set(opts, "flush_packets", "1", 0);
+    } else {
+        av_dict_set(opts, "movflags", "empty_moov", 0);
+    }
+}
+
+/**
+ * Initialize a persistent segment input
+ */
+int mp4_segment_input_init(mp4_segment_input_t *input, const char *rtsp_url,
+                           stream_ingest_consumer_t *consumer) {
+    if (!input || (!rtsp_url && !consumer)) {
+        log_error("Invalid parameters for mp4_segment_input_init");
+        return -1;
+    }
+
+    memset(input, 0, sizeof(mp4_segment_input_t));
+    if (rtsp_url) {
+        strncpy(input->url, rtsp_url, MAX_PATH_LENGTH - 1);
+        input->url[MAX_PATH_LENGTH - 1] = '\0';
+    }
+    input->consumer = consumer;
+
+    input->carry_pkt = av_packet_alloc();
+    if (!input->carry_pkt) {
+        log_error("Failed to allocate carry-over packet for persistent input");
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Record the next segment from a persistent input
+ */
+int record_segment_continuous(mp4_segment_input_t *input, const char *output_file,
+                              int duration, int has_audio, mp4_segment_boundary_t *boundary) {
+    if (!input || !output_file) {
+        log_error("Invalid parameters for record_segment_continuous");
+        return -1;
+    }
+
+    return record_segment_internal(NULL, input, output_file, duration, has_audio, boundary);
+}
+
+/**
+ * Close a persistent segment input
+ */
+void mp4_segment_input_close(mp4_segment_input_t *input) {
+    if (!input) {
+        return;
+    }
+
+    if (input->carry_pkt) {
+        av_packet_free(&input->carry_pkt);
+    }
+
+    if (input->input_ctx) {
+        avformat_close_input(&input->input_ctx);
+        log_debug("Closed persistent input context for %s", input->url);
+    }
+
+    // The shared ingest consumer is owned and detached by the caller
+    input->consumer = NULL;
+}
+
 /**
  * Clean up all static resources used by the MP4 segment recorder
  * This function should be called during program shutdown to prevent memory leaks
@@ -1192,15 +1374,15 @@ int mp4_segment_recorder_write_packet(mp4_writer_t *writer, const AVPacket *pkt,
     }
 
     if (!writer->output_ctx) {
-        log_error("Writer output context is NULL for stream %s",
+        log_error_ratelimited("Writer output context is NULL for stream %s",
                 writer->stream_name ? writer->stream_name : "unknown");
         return -1;
     }
 
     // Create a copy of the packet to avoid modifying the original
-    AVPacket *out_pkt = av_packet_alloc();
+    AVPacket *out_pkt = packet_pool_get_packet(writer->packet_pool);
     if (!out_pkt) {
-        log_error("Failed to allocate packet for stream %s",
+        log_error_ratelimited("Failed to allocate packet for stream %s",
                 writer->stream_name ? writer->stream_name : "unknown");
         return -1;
     }
@@ -1210,9 +1392,9 @@ int mp4_segment_recorder_write_packet(mp4_writer_t *writer, const AVPacket *pkt,
     if (ret < 0) {
         char error_buf[AV_ERROR_MAX_STRING_SIZE] = {0};
         av_strerror(ret, error_buf, AV_ERROR_MAX_STRING_SIZE);
-        log_error("Failed to copy packet for stream %s: %s",
+        log_error_ratelimited("Failed to copy packet for stream %s: %s",
                 writer->stream_name ? writer->stream_name : "unknown", error_buf);
-        av_packet_free(&out_pkt);
+        packet_pool_put_packet(writer->packet_pool, &out_pkt);
         return ret;
     }
 
@@ -1231,26 +1413,28 @@ int mp4_segment_recorder_write_packet(mp4_writer_t *writer, const AVPacket *pkt,
             out_pkt->stream_index = writer->audio.stream_idx;
         } else {
             // No audio stream in the output, drop the packet
-            av_packet_free(&out_pkt);
+            packet_pool_put_packet(writer->packet_pool, &out_pkt);
             return 0;
         }
     } else {
         // Unknown stream type, drop the packet
-        av_packet_free(&out_pkt);
+        packet_pool_put_packet(writer->packet_pool, &out_pkt);
         return 0;
     }
 
     // Write the packet to the output
+    uint64_t started_us = metrics_now_us();
     ret = av_interleaved_write_frame(writer->output_ctx, out_pkt);
+    metrics_observe_since(writer->write_metric, started_us);
     if (ret < 0) {
         char error_buf[AV_ERROR_MAX_STRING_SIZE] = {0};
         av_strerror(ret, error_buf, AV_ERROR_MAX_STRING_SIZE);
-        log_error("Error writing frame for stream %s: %s",
+        log_error_ratelimited("Error writing frame for stream %s: %s",
                 writer->stream_name ? writer->stream_name : "unknown", error_buf);
     }
 
     // Free the packet
-    av_packet_free(&out_pkt);
+    packet_pool_put_packet(writer->packet_pool, &out_pkt);
 
     return ret;
 }
@@ -0,0 +1,460 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/rational.h>
+
+#include "core/logger.h"
+#include "core/config.h"
+#include "core/metrics.h"
+#include "video/mp4_standby.h"
+#include "video/mp4_writer.h"
+#include "video/mp4_segment_recorder.h"
+#include "video/stream_manager.h"
+#include "video/stream_ingest.h"
+#include "video/streams.h"
+#include "video/hls_recording.h"
+#include "video/thread_utils.h"
+#include "storage/storage_io.h"
+#include "storage/storage_manager.h"
+
+// Seconds between checks of the streams
+#define STANDBY_CHECK_SECONDS 2
+
+// Age at which a standby output is made again, in the directory of the current hour
+#define STANDBY_REFRESH_SECONDS 900
+
+// Name of the file of a standby output, hidden in the stream's recording directory
+#define STANDBY_FILE_NAME ".standby.partial"
+
+// Output prepared ahead of a recording
+typedef struct {
+    AVFormatContext *ctx;           // Header written, file open through the storage I/O thread
+    AVCodecParameters *video_par;   // Streams as the ingest delivered them
+    AVCodecParameters *audio_par;   // NULL without audio
+    AVRational video_time_base;
+    AVRational audio_time_base;
+    char path[MAX_PATH_LENGTH];
+    time_t prepared;
+} standby_output_t;
+
+typedef struct {
+    bool used;
+    char stream_name[MAX_STREAM_NAME];
+    standby_output_t *output;       // NULL while there is none
+    uint64_t triggered_us;          // When the recording was started, 0 once timed
+    uint64_t last_bytes;            // Ingest bytes at the last check, for the bitrate
+    uint64_t last_check_us;
+    int64_t byte_rate;              // Bytes per second, 0 until measured
+} standby_slot_t;
+
+static standby_slot_t slots[MAX_STREAMS];
+static pthread_t standby_thread;
+static bool standby_running = false;
+static pthread_mutex_t standby_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t standby_cond = PTHREAD_COND_INITIALIZER;   // Signaled to stop the thread
+
+static metric_t hit_metric;
+static metric_t miss_metric;
+
+/**
+ * Find the slot of a stream
+ * Must be called with standby_mutex held.
+ */
+static standby_slot_t *find_slot_locked(const char *stream_name, bool create) {
+    standby_slot_t *free_slot = NULL;
+    for (int i = 0; i < MAX_STREAMS; i++) {
+        if (slots[i].used && strcmp(slots[i].stream_name, stream_name) == 0) {
+            return &slots[i];
+        }
+        if (!slots[i].used && !free_slot) {
+            free_slot = &slots[i];
+        }
+    }
+
+    if (!create || !free_slot) {
+        return NULL;
+    }
+    memset(free_slot, 0, sizeof(*free_slot));
+    free_slot->used = true;
+    strncpy(free_slot->stream_name, stream_name, MAX_STREAM_NAME - 1);
+    return free_slot;
+}
+
+/**
+ * Close a standby output and remove its file
+ */
+static void discard_output(standby_output_t *output) {
+    if (!output) {
+        return;
+    }
+
+    if (output->ctx) {
+        if (output->ctx->pb) {
+            storage_io_close_avio(&output->ctx->pb);
+        }
+        avformat_free_context(output->ctx);
+    }
+    if (output->path[0] != '\0' && unlink(output->path) != 0) {
+        log_debug("Failed to remove standby output %s", output->path);
+    }
+    avcodec_parameters_free(&output->video_par);
+    avcodec_parameters_free(&output->audio_par);
+    free(output);
+}
+
+/**
+ * Check that a stream of the input is the one a standby output was made for
+ */
+static bool same_stream(const AVCodecParameters *par, AVRational time_base, const AVStream *stream) {
+    const AVCodecParameters *in = stream->codecpar;
+    return par->codec_id == in->codec_id &&
+           par->width == in->width &&
+           par->height == in->height &&
+           par->sample_rate == in->sample_rate &&
+           par->extradata_size == in->extradata_size &&
+           (par->extradata_size == 0 || memcmp(par->extradata, in->extradata, par->extradata_size) == 0) &&
+           av_cmp_q(time_base, stream->time_base) == 0;
+}
+
+/**
+ * Make a standby output for a stream
+ *
+ * @param config Stream configuration
+ * @param expected_size Bytes to preallocate
+ * @return Output, or NULL if the ingest has no streams yet or the output could not be made
+ */
+static standby_output_t *prepare_output(const stream_config_t *config, int64_t expected_size) {
+    standby_output_t *output = calloc(1, sizeof(standby_output_t));
+    if (!output) {
+        return NULL;
+    }
+
+    char path[MAX_PATH_LENGTH];
+    char *slash;
+    if (get_recording_path(config->name, time(NULL), path, sizeof(path)) != 0 ||
+        !(slash = strrchr(path, '/'))) {
+        free(output);
+        return NULL;
+    }
+    *slash = '\0';
+
+    AVFormatContext *ctx = NULL;
+    if (avformat_alloc_output_context2(&ctx, NULL, "mp4", NULL) < 0 || !ctx) {
+        free(output);
+        return NULL;
+    }
+    output->ctx = ctx;
+
+    if (stream_ingest_add_output_streams(config->name, ctx, config->record_audio) != 0 ||
+        ctx->nb_streams == 0 ||
+        ctx->streams[0]->codecpar->width == 0 || ctx->streams[0]->codecpar->height == 0) {
+        discard_output(output);
+        return NULL;
+    }
+
+    // The muxer picks its own time bases in the header, so keep what the ingest delivers
+    output->video_par = avcodec_parameters_alloc();
+    if (!output->video_par || avcodec_parameters_copy(output->video_par, ctx->streams[0]->codecpar) < 0) {
+        discard_output(output);
+        return NULL;
+    }
+    output->video_time_base = ctx->streams[0]->time_base;
+    if (ctx->nb_streams > 1) {
+        output->audio_par = avcodec_parameters_alloc();
+        if (!output->audio_par || avcodec_parameters_copy(output->audio_par, ctx->streams[1]->codecpar) < 0) {
+            discard_output(output);
+            return NULL;
+        }
+        output->audio_time_base = ctx->streams[1]->time_base;
+    }
+
+    // Only a file of the storage I/O thread can be renamed once it is open
+    snprintf(output->path, sizeof(output->path), "%s/%s", path, STANDBY_FILE_NAME);
+    if (storage_io_open_avio(&ctx->pb, output->path, expected_size) < 0) {
+        output->path[0] = '\0';
+        discard_output(output);
+        return NULL;
+    }
+
+    AVDictionary *opts = NULL;
+    mp4_segment_output_options(&opts);
+    int ret = avformat_write_header(ctx, &opts);
+    av_dict_free(&opts);
+    if (ret < 0) {
+        log_debug("Failed to write the header of the standby output for %s: %d", config->name, ret);
+        discard_output(output);
+        return NULL;
+    }
+
+    output->prepared = time(NULL);
+    return output;
+}
+
+/**
+ * Check whether a stream should have a standby output
+ */
+static bool wants_standby(const stream_config_t *config) {
+    return config->enabled && config->detection_based_recording &&
+           !hls_recording_applies(config) &&
+           get_recording_state(config->name) == 0;
+}
+
+/**
+ * Bring the standby output of one stream up to date
+ */
+static void check_stream(const stream_config_t *config) {
+    stream_ingest_stats_t stats;
+    bool connected = stream_ingest_get_stats(config->name, &stats) == 0 && stats.connected;
+    bool wanted = connected && wants_standby(config);
+    uint64_t now_us = metrics_now_us();
+    time_t now = time(NULL);
+
+    pthread_mutex_lock(&standby_mutex);
+    standby_slot_t *slot = find_slot_locked(config->name, wanted);
+    if (!slot) {
+        pthread_mutex_unlock(&standby_mutex);
+        return;
+    }
+
+    // Bitrate of the ingest, for preallocating a segment
+    if (connected && slot->last_check_us > 0 && stats.bytes_read >= slot->last_bytes &&
+        now_us > slot->last_check_us) {
+        slot->byte_rate = (int64_t)((stats.bytes_read - slot->last_bytes) * 1000000 /
+                                    (now_us - slot->last_check_us));
+    }
+    slot->last_bytes = stats.bytes_read;
+    slot->last_check_us = now_us;
+
+    standby_output_t *stale = NULL;
+    if (slot->output && (!wanted || now - slot->output->prepared >= STANDBY_REFRESH_SECONDS)) {
+        stale = slot->output;
+        slot->output = NULL;
+    }
+    bool prepare = wanted && !slot->output && slot->byte_rate > 0;
+    int64_t expected_size = slot->byte_rate * (config->segment_duration > 0 ? config->segment_duration : 0);
+    pthread_mutex_unlock(&standby_mutex);
+
+    discard_output(stale);
+    if (!prepare) {
+        return;
+    }
+
+    standby_output_t *output = prepare_output(config, expected_size + expected_size / 8);
+    if (!output) {
+        return;
+    }
+
+    // A recording may have started meanwhile; it set up its own output then
+    pthread_mutex_lock(&standby_mutex);
+    slot = find_slot_locked(config->name, false);
+    if (slot && !slot->output && get_recording_state(config->name) == 0) {
+        slot->output = output;
+        output = NULL;
+    }
+    pthread_mutex_unlock(&standby_mutex);
+
+    if (output) {
+        discard_output(output);
+    } else {
+        log_debug("Standby output ready for %s", config->name);
+    }
+}
+
+static void *mp4_standby_func(void *arg) {
+    (void)arg;
+    thread_set_identity(THREAD_CLASS_SERVICE, "mp4-standby", NULL);
+
+    pthread_mutex_lock(&standby_mutex);
+    while (standby_running) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += STANDBY_CHECK_SECONDS;
+        pthread_cond_timedwait(&standby_cond, &standby_mutex, &deadline);
+        if (!standby_running) {
+            break;
+        }
+        pthread_mutex_unlock(&standby_mutex);
+
+        if (stream_ingest_enabled()) {
+            int count = get_total_stream_count();
+            for (int i = 0; i < count; i++) {
+                const stream_config_t *config = stream_config_acquire(get_stream_by_index(i));
+                if (config) {
+                    check_stream(config);
+                    stream_config_release(config);
+                }
+            }
+        }
+
+        pthread_mutex_lock(&standby_mutex);
+    }
+    pthread_mutex_unlock(&standby_mutex);
+
+    return NULL;
+}
+
+int mp4_standby_init(void) {
+    if (!g_config.mp4_standby) {
+        log_info("MP4 standby outputs disabled");
+        return 0;
+    }
+
+    pthread_mutex_lock(&standby_mutex);
+    if (standby_running) {
+        pthread_mutex_unlock(&standby_mutex);
+        return 0;
+    }
+
+    hit_metric = metrics_counter("lightnvr_recording_standby_total",
+                                 "Recordings started with and without a standby output",
+                                 "result", "hit", NULL);
+    miss_metric = metrics_counter("lightnvr_recording_standby_total",
+                                  "Recordings started with and without a standby output",
+                                  "result", "miss", NULL);
+
+    memset(slots, 0, sizeof(slots));
+    standby_running = true;
+    if (pthread_create(&standby_thread, NULL, mp4_standby_func, NULL) != 0) {
+        log_error("Failed to start MP4 standby thread");
+        standby_running = false;
+        pthread_mutex_unlock(&standby_mutex);
+        return -1;
+    }
+    pthread_mutex_unlock(&standby_mutex);
+
+    log_info("MP4 standby outputs enabled for detection-based recording");
+    return 0;
+}
+
+void mp4_standby_shutdown(void) {
+    pthread_mutex_lock(&standby_mutex);
+    if (!standby_running) {
+        pthread_mutex_unlock(&standby_mutex);
+        return;
+    }
+    standby_running = false;
+    pthread_cond_signal(&standby_cond);
+    pthread_mutex_unlock(&standby_mutex);
+
+    pthread_join(standby_thread, NULL);
+
+    pthread_mutex_lock(&standby_mutex);
+    for (int i = 0; i < MAX_STREAMS; i++) {
+        discard_output(slots[i].output);
+        slots[i].output = NULL;
+        slots[i].used = false;
+    }
+    pthread_mutex_unlock(&standby_mutex);
+
+    log_info("MP4 standby outputs stopped");
+}
+
+bool mp4_standby_ready(const char *stream_name) {
+    if (!stream_name) {
+        return false;
+    }
+
+    pthread_mutex_lock(&standby_mutex);
+    standby_slot_t *slot = find_slot_locked(stream_name, false);
+    bool ready = slot && slot->output;
+    pthread_mutex_unlock(&standby_mutex);
+    return ready;
+}
+
+void mp4_standby_triggered(const char *stream_name) {
+    if (!stream_name) {
+        return;
+    }
+
+    pthread_mutex_lock(&standby_mutex);
+    standby_slot_t *slot = find_slot_locked(stream_name, false);
+    if (slot) {
+        slot->triggered_us = metrics_now_us();
+    }
+    pthread_mutex_unlock(&standby_mutex);
+}
+
+AVFormatContext *mp4_standby_take(const char *stream_name, const char *output_file,
+                                  const AVFormatContext *input_ctx, int video_idx, int audio_idx) {
+    if (!stream_name || !output_file || !input_ctx || video_idx < 0) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&standby_mutex);
+    standby_slot_t *slot = find_slot_locked(stream_name, false);
+    standby_output_t *output = slot ? slot->output : NULL;
+    if (slot) {
+        slot->output = NULL;
+    }
+    pthread_mutex_unlock(&standby_mutex);
+
+    // Only streams kept on standby count; the others never had one
+    if (!slot) {
+        return NULL;
+    }
+    if (!output) {
+        metrics_add(miss_metric, 1);
+        return NULL;
+    }
+
+    bool matches = same_stream(output->video_par, output->video_time_base, input_ctx->streams[video_idx]) &&
+                   (audio_idx >= 0) == (output->audio_par != NULL) &&
+                   (audio_idx < 0 ||
+                    same_stream(output->audio_par, output->audio_time_base, input_ctx->streams[audio_idx]));
+    if (!matches) {
+        log_info("Stream %s changed since its standby output was made, setting up a new one", stream_name);
+        discard_output(output);
+        metrics_add(miss_metric, 1);
+        return NULL;
+    }
+
+    int ret = storage_io_rename_avio(output->ctx->pb, output_file);
+    if (ret < 0) {
+        log_warn("Failed to rename standby output of %s to %s: %d", stream_name, output_file, ret);
+        discard_output(output);
+        metrics_add(miss_metric, 1);
+        return NULL;
+    }
+
+    AVFormatContext *ctx = output->ctx;
+    output->ctx = NULL;
+    output->path[0] = '\0';
+    discard_output(output);
+
+    metrics_add(hit_metric, 1);
+    log_info("Recording of %s continues its standby output as %s", stream_name, output_file);
+    return ctx;
+}
+
+void mp4_standby_output_ready(const char *stream_name) {
+    if (!stream_name) {
+        return;
+    }
+
+    pthread_mutex_lock(&standby_mutex);
+    standby_slot_t *slot = find_slot_locked(stream_name, false);
+    uint64_t triggered_us = slot ? slot->triggered_us : 0;
+    if (slot) {
+        slot->triggered_us = 0;
+    }
+    pthread_mutex_unlock(&standby_mutex);
+
+    if (triggered_us == 0) {
+        return;
+    }
+
+    metric_t metric = metrics_histogram("lightnvr_recording_trigger_seconds",
+                                        "Time from starting a recording to its header being written",
+                                        "stream", stream_name, NULL);
+    metrics_observe_since(metric, triggered_us);
+}
@@ -32,6 +32,7 @@
 #include "video/mp4_writer_internal.h"
 #include "video/mp4_segment_recorder.h"
 #include "video/mp4_writer_thread.h"
+#include "video/audio_transcode.h"
 #include "database/database_manager.h"
 #include "database/db_recordings.h"
 
@@ -122,11 +123,10 @@ int mp4_writer_has_audio(mp4_writer_t *writer) {
 }
 
 
-// Forward declaration of transcode_audio_packet function
-extern int transcode_audio_packet(const char *stream_name,
-                                const AVPacket *in_pkt,
-                                AVPacket *out_pkt,
-                                const AVStream *input_stream);
+// Defined in mp4_writer_utils.c
+extern audio_transcoder_t *get_audio_transcoder(const char *stream_name,
+                                                const AVCodecParameters *codec_params,
+                                                AVRational time_base);
 
 /**
  * Write a packet to the MP4 file
@@ -152,44 +152,44 @@ int mp4_writer_write_packet(mp4_writer_t *writer, const AVPacket *in_pkt, const
         return 0;
     }
 
-    // If this is an audio packet with an incompatible codec, try to transcode it
-    if (input_stream->codecpar->codec_type == AVMEDIA_TYPE_AUDIO) {
-        if (input_stream->codecpar->codec_id == AV_CODEC_ID_PCM_MULAW ||
-            input_stream->codecpar->codec_id == AV_CODEC_ID_PCM_ALAW) {
-
-            // Create a new packet for the transcoded audio
-            AVPacket *transcoded_pkt = av_packet_alloc();
-            if (!transcoded_pkt) {
-                log_error("Failed to allocate packet for transcoded audio");
-                return -1;
-            }
-
-            // Transcode the audio packet
-            int ret = transcode_audio_packet(writer->stream_name,
-                                           in_pkt,
-                                           transcoded_pkt,
-                                           input_stream);
-
-            if (ret < 0) {
-                log_error("Failed to transcode audio packet for %s", writer->stream_name);
-                av_packet_free(&transcoded_pkt);
-                return 0; // Return success but don't write the packet
-            }
-
-            if (transcoded_pkt->size <= 0) {
-                // No output packet was generated, this is normal for some frames
-                av_packet_free(&transcoded_pkt);
-                return 0; // Return success but don't write the packet
-            }
-
-            // Write the transcoded packet
-            ret = mp4_segment_recorder_write_packet(writer, transcoded_pkt, input_stream);
-
-            // Free the transcoded packet
-            av_packet_free(&transcoded_pkt);
-
-            return ret;
+    // G.711 only arrives here when the writer reads the camera itself; the
+    // shared ingest hands out AAC already
+    if (input_stream->codecpar->codec_type == AVMEDIA_TYPE_AUDIO &&
+        audio_transcode_needed(input_stream->codecpar->codec_id)) {
+        audio_transcoder_t *tc = get_audio_transcoder(writer->stream_name, input_stream->codecpar,
+                                                      input_stream->time_base);
+        if (!tc) {
+            log_error_ratelimited("No audio transcoder for %s", writer->stream_name);
+            return 0; // Return success but don't write the packet
         }
+
+        int ret = audio_transcoder_send_packet(tc, in_pkt);
+        if (ret < 0) {
+            log_error_ratelimited("Failed to transcode audio packet for %s", writer->stream_name);
+            return 0; // Return success but don't write the packet
+        }
+
+        // Create a new packet for the transcoded audio
+        AVPacket *transcoded_pkt = packet_pool_get_packet(writer->packet_pool);
+        if (!transcoded_pkt) {
+            log_error_ratelimited("Failed to allocate packet for transcoded audio");
+            return -1;
+        }
+
+        // A packet completes zero or more AAC frames
+        int write_ret = 0;
+        while (write_ret >= 0 && audio_transcoder_receive_packet(tc, transcoded_pkt) == 0) {
+            // The recorder rescales from the input stream's time base
+            av_packet_rescale_ts(transcoded_pkt, audio_transcoder_get_time_base(tc), input_stream->time_base);
+            transcoded_pkt->stream_index = in_pkt->stream_index;
+            write_ret = mp4_segment_recorder_write_packet(writer, transcoded_pkt, input_stream);
+            av_packet_unref(transcoded_pkt);
+        }
+
+        // Free the transcoded packet
+        packet_pool_put_packet(writer->packet_pool, &transcoded_pkt);
+
+        return write_ret;
     }
 
     // Process normal packets
@@ -25,23 +25,43 @@
 
 #include "database/database_manager.h"
 #include "core/config.h"
+#include "core/event_bus.h"
 #include "core/logger.h"
+#include "utils/memory.h"
 #include "video/stream_manager.h"
 #include "video/streams.h"
+#include "video/stream_arena.h"
 #include "video/mp4_writer.h"
 #include "video/mp4_writer_internal.h"
+#include "video/recording_thumbnails.h"
+#include "video/recording_index.h"
 
 extern active_recording_t active_recordings[MAX_STREAMS];
 
+/**
+ * Announce a recording whose file is final on the event bus
+ */
+void mp4_writer_publish_finished(const char *stream_name, uint64_t recording_id) {
+    bus_event_t event = {
+        .type = BUS_EVENT_RECORDING_FINISHED,
+        .time = time(NULL),
+        .pts = -1,
+        .recording_id = recording_id,
+    };
+    snprintf(event.stream_name, sizeof(event.stream_name), "%s", stream_name);
+    event_bus_publish(&event);
+}
+
 /**
  * Create a new MP4 writer
  */
 mp4_writer_t *mp4_writer_create(const char *output_path, const char *stream_name) {
-    mp4_writer_t *writer = calloc(1, sizeof(mp4_writer_t));
+    mp4_writer_t *writer = stream_arena_alloc(stream_name, sizeof(mp4_writer_t));
     if (!writer) {
         log_error("Failed to allocate memory for MP4 writer");
         return NULL;
     }
+    memory_track(MEMORY_TAG_MP4, sizeof(mp4_writer_t), true);
 
     // Initialize writer
     strncpy(writer->output_path, output_path, sizeof(writer->output_path) - 1);
@@ -54,6 +74,7 @@ mp4_writer_t *mp4_writer_create(const char *output_path, const char *stream_name
     writer->last_packet_time = 0;  // Initialize to 0 to indicate no packets written yet
     writer->has_audio = 1;         // Initialize to 1 to enable audio by default
     writer->current_recording_id = 0; // Initialize to 0 to indicate no recording ID yet
+    writer->packet_pool = packet_pool_acquire(stream_name);
 
     // Initialize audio state
     writer->audio.stream_idx = -1; // Initialize to -1 to indicate no audio stream
@@ -71,6 +92,9 @@ mp4_writer_t *mp4_writer_create(const char *output_path, const char *stream_name
     writer->waiting_for_keyframe = 0;
     writer->is_rotating = 0;       // Initialize rotation flag
     writer->shutdown_component_id = -1; // Initialize to -1 to indicate not registered
+    writer->write_metric = metrics_histogram("lightnvr_mp4_write_seconds",
+                                             "Time to write a packet to the MP4 recording",
+                                             "stream", stream_name, NULL);
 
     // Extract output directory from output path
     strncpy(writer->output_dir, output_path, sizeof(writer->output_dir) - 1);
@@ -105,6 +129,22 @@ void mp4_writer_set_segment_duration(mp4_writer_t *writer, int segment_duration)
              segment_duration, writer->stream_name ? writer->stream_name : "unknown");
 }
 
+/**
+ * Register a callback for segment boundaries
+ */
+void mp4_writer_set_segment_callback(mp4_writer_t *writer, mp4_writer_segment_callback_t callback,
+                                     void *user_data) {
+    if (!writer) {
+        log_error("NULL writer passed to mp4_writer_set_segment_callback");
+        return;
+    }
+
+    pthread_mutex_lock(&writer->mutex);
+    writer->segment_callback = callback;
+    writer->segment_callback_data = user_data;
+    pthread_mutex_unlock(&writer->mutex);
+}
+
 /**
  * Close the MP4 writer and release resources
  */
@@ -198,6 +238,15 @@ void mp4_writer_close(mp4_writer_t *writer) {
         writer->output_ctx = NULL;
     }
 
+    // The last recording is final now that the thread and the file are closed
+    if (writer->current_recording_id > 0 && writer->output_path) {
+        if (g_config.mp4_fragmented) {
+            recording_index_build(writer->output_path);
+        }
+        recording_thumbnails_queue(writer->current_recording_id, writer->output_path);
+        mp4_writer_publish_finished(writer->stream_name, writer->current_recording_id);
+    }
+
     //  Ensure we're not in the middle of a rotation
     if (writer->is_rotating) {
         log_warn("MP4 writer was still rotating during close, forcing rotation to complete");
@@ -220,8 +269,9 @@ void mp4_writer_close(mp4_writer_t *writer) {
     extern void cleanup_audio_transcoder(const char *stream_name);
     cleanup_audio_transcoder(writer->stream_name);
 
-    // Free the writer structure
-    free(writer);
+    // Return the writer structure to the stream's arena
+    stream_arena_free(writer);
+    memory_track(MEMORY_TAG_MP4, sizeof(mp4_writer_t), false);
 
     log_info("MP4 writer closed and resources freed");
 }
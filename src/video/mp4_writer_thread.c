@@ -25,13 +25,21 @@
 #include <libavutil/time.h>
 
 #include "core/logger.h"
+#include "core/config.h"
 #include "core/shutdown_coordinator.h"
+#include "utils/memory.h"
 #include "video/mp4_writer.h"
 #include "video/mp4_writer_internal.h"
 #include "video/mp4_writer_thread.h"
 #include "video/mp4_segment_recorder.h"
+#include "video/stream_ingest.h"
+#include "video/stream_arena.h"
+#include "video/thread_utils.h"
+#include "video/recording_thumbnails.h"
+#include "video/recording_index.h"
 #include "database/database_manager.h"
 #include "database/db_recordings.h"
+#include "storage/storage_manager.h"
 
 
 /**
@@ -47,6 +55,7 @@ static void *mp4_writer_rtsp_thread(void *arg) {
 
     // Set running flag at start of thread
     thread_ctx->running = 1;
+    thread_set_identity(THREAD_CLASS_RECORDING, "mp4", thread_ctx->writer->stream_name);
 
     // Create a local copy of needed values to prevent use-after-free
     char rtsp_url[MAX_PATH_LENGTH];
@@ -56,8 +65,6 @@ static void *mp4_writer_rtsp_thread(void *arg) {
     int segment_duration = thread_ctx->segment_duration;
     mp4_writer_t *writer = thread_ctx->writer;
 
-    AVFormatContext *input_ctx = NULL;
-    AVPacket *pkt = NULL;
     int video_stream_idx = -1;
     int audio_stream_idx = -1;
     int ret;
@@ -119,6 +126,44 @@ static void *mp4_writer_rtsp_thread(void *arg) {
     log_info("Initialized segment info: index=%d, has_audio=%d, last_frame_was_key=%d",
             segment_info.segment_index, segment_info.has_audio, segment_info.last_frame_was_key);
 
+    // Share the camera connection with HLS and detection instead of opening our own
+    stream_ingest_consumer_t *ingest_consumer = NULL;
+    if (stream_ingest_enabled()) {
+        stream_config_t ingest_config;
+        int protocol = STREAM_PROTOCOL_TCP;
+        bool event_without_preroll = false;
+        if (get_stream_config_by_name(stream_name, &ingest_config) == 0) {
+            protocol = ingest_config.protocol;
+            event_without_preroll = ingest_config.detection_based_recording &&
+                                    ingest_config.pre_detection_buffer <= 0;
+        }
+
+        // Event recordings start with the pre-detection buffer when one is configured, and
+        // otherwise with the GOP in progress, so the frames that triggered them are not lost
+        if (event_without_preroll) {
+            ingest_consumer = stream_ingest_attach_with_gop(stream_name, rtsp_url, protocol, "mp4", 0, false);
+        } else {
+            ingest_consumer = stream_ingest_attach_with_preroll(stream_name, rtsp_url, protocol, "mp4", 0, false);
+        }
+        if (!ingest_consumer) {
+            log_warn("Failed to attach MP4 recording for %s to shared ingest, using a dedicated connection",
+                    stream_name);
+        }
+    }
+
+    // Keep the input open across segments so that only the output file rotates
+    mp4_segment_input_t segment_input;
+    if (mp4_segment_input_init(&segment_input, rtsp_url, ingest_consumer) != 0) {
+        log_error("Failed to initialize segment input for stream %s", stream_name);
+        if (ingest_consumer) {
+            stream_ingest_detach(ingest_consumer);
+        }
+        return NULL;
+    }
+    strncpy(segment_input.stream_name, stream_name, MAX_STREAM_NAME - 1);
+    mp4_segment_boundary_t boundary = {0};
+    bool segment_completed = false;
+
     // Main loop to record segments
     while (thread_ctx->running && !thread_ctx->shutdown_requested) {
         // Check if shutdown has been initiated
@@ -164,28 +209,39 @@ static void *mp4_writer_rtsp_thread(void *arg) {
         }
 
         // Check if it's time to create a new segment based on segment duration
-        // Force segment rotation every segment_duration seconds
-        if (segment_duration > 0) {
+        // A completed segment always moves on to a new file, otherwise rotate every segment_duration seconds
+        if (segment_duration > 0 || segment_completed) {
             time_t elapsed_time = current_time - thread_ctx->writer->last_rotation_time;
-            if (elapsed_time >= segment_duration) {
+            if (segment_completed || elapsed_time >= segment_duration) {
                 log_info("Time to create new segment for stream %s (elapsed time: %ld seconds, segment duration: %d seconds)",
                          stream_name, (long)elapsed_time, segment_duration);
 
-                // Create timestamp for new MP4 filename
-                char timestamp_str[32];
-                struct tm *tm_info = localtime(&current_time);
-                strftime(timestamp_str, sizeof(timestamp_str), "%Y%m%d_%H%M%S", tm_info);
-
-                // Create new output path
+                // Create new output path, in the directory of the hour with shard_recordings
                 char new_path[MAX_PATH_LENGTH];
-                snprintf(new_path, MAX_PATH_LENGTH, "%s/recording_%s.mp4",
-                         thread_ctx->writer->output_dir, timestamp_str);
+                if (get_recording_path(stream_name, current_time, new_path, MAX_PATH_LENGTH) != 0) {
+                    log_error("Failed to create recording path for stream %s, rotating in %s",
+                              stream_name, thread_ctx->writer->output_dir);
+                    char timestamp_str[32];
+                    struct tm *tm_info = localtime(&current_time);
+                    strftime(timestamp_str, sizeof(timestamp_str), "%Y%m%d_%H%M%S", tm_info);
+                    snprintf(new_path, MAX_PATH_LENGTH, "%s/recording_%s.mp4",
+                             thread_ctx->writer->output_dir, timestamp_str);
+                }
 
                 // Get the current output path before closing
                 char current_path[MAX_PATH_LENGTH];
                 strncpy(current_path, thread_ctx->writer->output_path, MAX_PATH_LENGTH - 1);
                 current_path[MAX_PATH_LENGTH - 1] = '\0';
 
+                // Short segments (e.g. after an input change) can end within the same second
+                if (strcmp(new_path, current_path) == 0) {
+                    size_t len = strlen(new_path);
+                    if (len > 4) {
+                        snprintf(new_path + len - 4, MAX_PATH_LENGTH - (len - 4), "_%d.mp4",
+                                 thread_ctx->writer->segment_count);
+                    }
+                }
+
                 // Create recording metadata for the new file
                 recording_metadata_t metadata;
                 memset(&metadata, 0, sizeof(recording_metadata_t));
@@ -231,6 +287,32 @@ static void *mp4_writer_rtsp_thread(void *arg) {
                         log_info("Marked previous recording (ID: %llu) as complete for stream %s (size unknown)",
                                 (unsigned long long)thread_ctx->writer->current_recording_id, stream_name);
                     }
+
+                    if (g_config.mp4_fragmented) {
+                        recording_index_build(current_path);
+                    }
+                    recording_thumbnails_queue(thread_ctx->writer->current_recording_id, current_path);
+                    mp4_writer_publish_finished(stream_name, thread_ctx->writer->current_recording_id);
+                }
+
+                // Report the boundary of the segment that was just completed
+                if (segment_completed) {
+                    mp4_writer_segment_callback_t callback;
+                    void *callback_data;
+
+                    pthread_mutex_lock(&thread_ctx->writer->mutex);
+                    thread_ctx->writer->segment_count++;
+                    thread_ctx->writer->segment_start_time = boundary.start_time;
+                    thread_ctx->writer->segment_end_time = boundary.end_time;
+                    callback = thread_ctx->writer->segment_callback;
+                    callback_data = thread_ctx->writer->segment_callback_data;
+                    pthread_mutex_unlock(&thread_ctx->writer->mutex);
+
+                    if (callback) {
+                        callback(thread_ctx->writer, current_path, boundary.start_time,
+                                 boundary.end_time, callback_data);
+                    }
+                    segment_completed = false;
                 }
 
                 // Update the output path
@@ -260,79 +342,14 @@ static void *mp4_writer_rtsp_thread(void *arg) {
             log_info("No segment duration configured, using default: %d seconds", segment_duration);
         }
 
-        // Variables for retry mechanism and resource management
-        // CRITICAL FIX: These static variables should be initialized at the beginning of each call
-        // to prevent using uninitialized values during shutdown
-        static int segment_retry_count = 0;
-        static time_t last_segment_retry_time = 0;
-        static int segment_count = 0;
-
-        // Initialize static variables at the beginning of each segment recording
-        // This ensures they have valid values even during shutdown
-        segment_retry_count = 0;
-        last_segment_retry_time = 0;
-        // Don't reset segment_count as it's used for logging purposes
-
-        // Increment segment count and log it periodically to track memory usage
-        segment_count++;
-        if (segment_count % 10 == 0) {
-            log_info("Stream %s has processed %d segments since startup", stream_name, segment_count);
-
-            // Force a complete FFmpeg resource reset every 10 segments to prevent memory growth
-            if (segment_count % 10 == 0) {
-                log_info("Performing complete FFmpeg resource reset for stream %s after %d segments",
-                        stream_name, segment_count);
-
-                // MEMORY LEAK FIX: Ensure all FFmpeg resources are properly freed
-                // This is the most aggressive approach to prevent memory growth
-
-                // 1. Free the packet if it exists
-                if (pkt) {
-                    av_packet_unref(pkt);
-                    av_packet_free(&pkt);
-                    pkt = NULL;
-                }
-
-                // 2. Close the input context if it exists
-                if (input_ctx) {
-                    // Flush all buffers before closing
-                    if (input_ctx->pb) {
-                        avio_flush(input_ctx->pb);
-                    }
-
-                    // Close the input context - this will free all associated resources
-                    // Let FFmpeg handle its own memory management
-                    avformat_close_input(&input_ctx);
-                    input_ctx = NULL;
-                }
-
-                // 3. Allocate a new packet
-                pkt = av_packet_alloc();
-                if (!pkt) {
-                    log_error("Failed to allocate packet during FFmpeg resource reset");
-                    // Continue anyway, the next iteration will try again
-                }
-
-                // Log that we've reset all FFmpeg resources
-                log_info("Successfully reset all FFmpeg resources for stream %s", stream_name);
-            }
-        }
-
         // Record the segment with timestamp continuity and keyframe handling
         // BUGFIX: Removed duplicate loop that was causing segments to be double the intended length
         log_info("Starting segment recording with info: index=%d, has_audio=%d, last_frame_was_key=%d",
                 segment_info.segment_index, segment_info.has_audio, segment_info.last_frame_was_key);
 
-        // MEMORY LEAK FIX: Ensure we don't have any lingering input context before recording
-        // This is a safety measure to prevent resource leaks
-        if (input_ctx) {
-            avformat_close_input(&input_ctx);
-            input_ctx = NULL;
-            log_debug("Closed existing input context before recording new segment");
-        }
-
-        ret = record_segment(thread_ctx->rtsp_url, thread_ctx->writer->output_path,
-                           segment_duration, thread_ctx->writer->has_audio);
+        ret = record_segment_continuous(&segment_input, thread_ctx->writer->output_path,
+                                        segment_duration, thread_ctx->writer->has_audio, &boundary);
+        segment_info = segment_input.info;
 
         log_info("Finished segment recording with info: index=%d, has_audio=%d, last_frame_was_key=%d",
                 segment_info.segment_index, segment_info.has_audio, segment_info.last_frame_was_key);
@@ -341,12 +358,6 @@ static void *mp4_writer_rtsp_thread(void *arg) {
             log_error("Failed to record segment for stream %s (error: %d), implementing retry strategy...",
                      stream_name, ret);
 
-            // Check if input_ctx is NULL after a failed record_segment call
-            // This can happen if the connection failed and avformat_open_input failed
-            if (input_ctx == NULL) {
-                log_warn("Input context is NULL after record_segment failure for stream %s", stream_name);
-            }
-
             // Calculate backoff time based on retry count (exponential backoff with max of 30 seconds)
             int backoff_seconds = 1 << (thread_ctx->retry_count > 4 ? 4 : thread_ctx->retry_count); // 1, 2, 4, 8, 16, 16, ...
             if (backoff_seconds > 30) backoff_seconds = 30;
@@ -355,23 +366,11 @@ static void *mp4_writer_rtsp_thread(void *arg) {
             thread_ctx->retry_count++;
             thread_ctx->last_retry_time = time(NULL);
 
-            // If input context was closed, set it to NULL so it will be reopened
-            if (!input_ctx) {
-                log_info("Input context was closed, will reopen on next attempt");
-            }
-
             // If we've had too many consecutive failures, try more aggressive recovery
             if (thread_ctx->retry_count > 5) {
                 log_warn("Multiple segment recording failures for %s (%d retries), attempting aggressive recovery",
                         stream_name, thread_ctx->retry_count);
 
-                // Force input context to be recreated
-                if (input_ctx) {
-                    avformat_close_input(&input_ctx);
-                    input_ctx = NULL;
-                    log_info("Forcibly closed input context to ensure fresh connection on next attempt");
-                }
-
                 // Sleep longer for aggressive recovery
                 backoff_seconds = 5;
             }
@@ -385,6 +384,9 @@ static void *mp4_writer_rtsp_thread(void *arg) {
             // Continue the loop to retry
             continue;
         } else {
+            // The segment file is finished; the next iteration rotates to a new file
+            segment_completed = true;
+
             // Reset retry count on success
             if (thread_ctx->retry_count > 0) {
                 log_info("Successfully recorded segment for %s after %d retries",
@@ -410,62 +412,13 @@ static void *mp4_writer_rtsp_thread(void *arg) {
         }
     }
 
-    // MEMORY LEAK FIX: Aggressive cleanup of all FFmpeg resources
-    log_info("Performing aggressive cleanup of all FFmpeg resources for stream %s", stream_name);
-
-    // 1. Clean up packet resources
-    if (pkt) {
-        // Make a local copy of the packet pointer and NULL out the original
-        // to prevent double-free if another thread accesses it
-        AVPacket *pkt_to_free = pkt;
-        pkt = NULL;
-
-        // Now safely free the packet - first unref then free to prevent memory leaks
-        av_packet_unref(pkt_to_free);
-        av_packet_free(&pkt_to_free);
-        log_debug("Freed packet resources");
-    }
-
-    // 2. CRITICAL FIX: Always ensure input_ctx is properly closed to prevent memory leaks
-    if (input_ctx) {
-        // Make a local copy of the context pointer and NULL out the original
-        AVFormatContext *ctx_to_close = input_ctx;
-        input_ctx = NULL;
-
-        // Flush all buffers before closing
-        if (ctx_to_close->pb) {
-            avio_flush(ctx_to_close->pb);
-            log_debug("Flushed input context buffers");
-        }
-
-        // Ensure all packets are properly reference counted before closing
-        // This helps prevent use-after-free errors during shutdown
-        for (unsigned int i = 0; i < ctx_to_close->nb_streams; i++) {
-            if (ctx_to_close->streams[i] && ctx_to_close->streams[i]->codecpar) {
-                // Clear any cached packets
-                if (ctx_to_close->streams[i]->codecpar->extradata) {
-                    log_debug("Clearing extradata for stream %d", i);
-                    // Make sure extradata is properly freed
-                    av_freep(&ctx_to_close->streams[i]->codecpar->extradata);
-                    ctx_to_close->streams[i]->codecpar->extradata_size = 0;
-                }
-            }
-        }
-
-        // Now safely close the input context
-        avformat_close_input(&ctx_to_close);
-
-        // Log that we've closed the input context to help with debugging
-        log_info("Closed input context for stream %s to prevent memory leaks", stream_name);
+    // Close the persistent input, then release our place in the shared ingest
+    mp4_segment_input_close(&segment_input);
+    if (ingest_consumer) {
+        stream_ingest_detach(ingest_consumer);
+        ingest_consumer = NULL;
     }
 
-    // 3. Notify the segment recorder that we're shutting down
-    // This helps ensure proper cleanup of shared resources
-    mp4_segment_recorder_cleanup();
-
-    // Log that we've completed cleanup
-    log_info("Completed cleanup of FFmpeg resources for stream %s", stream_name);
-
     log_info("RTSP reading thread for stream %s exited", stream_name);
     return NULL;
 }
@@ -480,10 +433,11 @@ int mp4_writer_start_recording_thread(mp4_writer_t *writer, const char *rtsp_url
     }
 
     // Allocate and initialize thread context
-    writer->thread_ctx = (mp4_writer_thread_t *)calloc(1, sizeof(mp4_writer_thread_t));
+    writer->thread_ctx = stream_arena_alloc(writer->stream_name, sizeof(mp4_writer_thread_t));
     if (!writer->thread_ctx) {
         return -1;
     }
+    memory_track(MEMORY_TAG_MP4, sizeof(mp4_writer_thread_t), true);
 
     // Initialize thread context
     writer->thread_ctx->writer = writer;
@@ -493,10 +447,12 @@ int mp4_writer_start_recording_thread(mp4_writer_t *writer, const char *rtsp_url
     writer->thread_ctx->rtsp_url[sizeof(writer->thread_ctx->rtsp_url) - 1] = '\0';
 
     // Create thread with proper error handling
-    int ret = pthread_create(&writer->thread_ctx->thread, NULL, mp4_writer_rtsp_thread, writer->thread_ctx);
+    int ret = pthread_create_with_stack(&writer->thread_ctx->thread, mp4_writer_rtsp_thread, writer->thread_ctx,
+                                        STREAM_THREAD_STACK_SIZE, false);
     if (ret != 0) {
-        free(writer->thread_ctx);
+        stream_arena_free(writer->thread_ctx);
         writer->thread_ctx = NULL;
+        memory_track(MEMORY_TAG_MP4, sizeof(mp4_writer_thread_t), false);
         return -1;
     }
 
@@ -510,7 +466,7 @@ int mp4_writer_start_recording_thread(mp4_writer_t *writer, const char *rtsp_url
         writer->stream_name,
         COMPONENT_MP4_WRITER,
         writer,
-        10  // Medium priority
+        COMPONENT_PRIORITY_MP4
     );
 
     if (writer->shutdown_component_id >= 0) {
@@ -548,9 +504,10 @@ void mp4_writer_stop_recording_thread(mp4_writer_t *writer) {
         memset(writer->thread_ctx->rtsp_url, 0, sizeof(writer->thread_ctx->rtsp_url));
     }
 
-    // Free thread context
-    free(writer->thread_ctx);
+    // Return the thread context to the stream's arena
+    stream_arena_free(writer->thread_ctx);
     writer->thread_ctx = NULL;
+    memory_track(MEMORY_TAG_MP4, sizeof(mp4_writer_thread_t), false);
 
     // Update component state in shutdown coordinator
     if (writer->shutdown_component_id >= 0) {
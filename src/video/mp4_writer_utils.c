@@ -28,210 +28,58 @@
 #include "video/mp4_writer.h"
 #include "video/mp4_writer_internal.h"
 #include "video/ffmpeg_utils.h"
+#include "video/audio_transcode.h"
 
-// Structure to hold audio transcoding context
-typedef struct {
-    AVCodecContext *decoder_ctx;
-    AVCodecContext *encoder_ctx;
-    AVFrame *frame;
-    AVPacket *in_pkt;
-    AVPacket *out_pkt;
-    int initialized;
-} audio_transcoder_t;
-
-// Global transcoder context for each stream
-static audio_transcoder_t audio_transcoders[MAX_STREAMS] = {0};
+// Audio transcoders of writers reading G.711 straight from the camera; with
+// the shared ingest the writer already receives AAC
+static audio_transcoder_t *audio_transcoders[MAX_STREAMS] = {0};
 static char audio_transcoder_stream_names[MAX_STREAMS][MAX_STREAM_NAME] = {{0}};
 static pthread_mutex_t audio_transcoder_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 /**
- * Initialize audio transcoder for a stream
+ * Get the audio transcoder of a stream, creating it if needed
  *
  * @param stream_name Name of the stream
- * @param codec_params Original codec parameters (μ-law)
+ * @param codec_params Original codec parameters (G.711)
  * @param time_base Time base of the original stream
- * @return Index of the transcoder in the array, or -1 on error
+ * @return Transcoder, or NULL on error
  */
-static int init_audio_transcoder(const char *stream_name,
-                               const AVCodecParameters *codec_params,
-                               const AVRational *time_base) {
-    int ret = -1;
-    int slot = -1;
-    const AVCodec *decoder = NULL;
-    const AVCodec *encoder = NULL;
+audio_transcoder_t *get_audio_transcoder(const char *stream_name,
+                                         const AVCodecParameters *codec_params,
+                                         AVRational time_base) {
+    if (!stream_name || !codec_params) {
+        return NULL;
+    }
 
     pthread_mutex_lock(&audio_transcoder_mutex);
 
-    // Find an empty slot or existing entry for this stream
+    int slot = -1;
     for (int i = 0; i < MAX_STREAMS; i++) {
-        if (!audio_transcoders[i].initialized) {
-            slot = i;
-            break;
-        } else if (audio_transcoder_stream_names[i][0] != '\0' &&
-                  strcmp(audio_transcoder_stream_names[i], stream_name) == 0) {
-            // Stream already has a transcoder, return its index
+        if (audio_transcoders[i] && strcmp(audio_transcoder_stream_names[i], stream_name) == 0) {
+            audio_transcoder_t *tc = audio_transcoders[i];
             pthread_mutex_unlock(&audio_transcoder_mutex);
-            return i;
+            return tc;
+        }
+        if (!audio_transcoders[i] && slot < 0) {
+            slot = i;
         }
     }
 
-    if (slot == -1) {
-        log_error("No available slots for audio transcoder registration");
-        pthread_mutex_unlock(&audio_transcoder_mutex);
-        return -1;
-    }
-
-    // Find the μ-law decoder
-    decoder = avcodec_find_decoder(codec_params->codec_id);
-    if (!decoder) {
-        log_error("Failed to find decoder for μ-law audio in %s", stream_name);
-        pthread_mutex_unlock(&audio_transcoder_mutex);
-        return -1;
-    }
-
-    // Find the AAC encoder
-    encoder = avcodec_find_encoder(AV_CODEC_ID_AAC);
-    if (!encoder) {
-        log_error("Failed to find AAC encoder for %s", stream_name);
+    if (slot < 0) {
+        log_error("No free audio transcoder slots for stream %s", stream_name);
         pthread_mutex_unlock(&audio_transcoder_mutex);
-        return -1;
-    }
-
-    // Create decoder context
-    audio_transcoders[slot].decoder_ctx = avcodec_alloc_context3(decoder);
-    if (!audio_transcoders[slot].decoder_ctx) {
-        log_error("Failed to allocate decoder context for %s", stream_name);
-        goto cleanup;
-    }
-
-    // Copy parameters to decoder context
-    ret = avcodec_parameters_to_context(audio_transcoders[slot].decoder_ctx, codec_params);
-    if (ret < 0) {
-        log_ffmpeg_error(ret, "Failed to copy parameters to decoder context");
-        goto cleanup;
+        return NULL;
     }
 
-    // Set time base
-    audio_transcoders[slot].decoder_ctx->time_base = *time_base;
-
-    // Open decoder
-    ret = avcodec_open2(audio_transcoders[slot].decoder_ctx, decoder, NULL);
-    if (ret < 0) {
-        log_ffmpeg_error(ret, "Failed to open μ-law decoder");
-        goto cleanup;
-    }
-
-    // Create encoder context
-    audio_transcoders[slot].encoder_ctx = avcodec_alloc_context3(encoder);
-    if (!audio_transcoders[slot].encoder_ctx) {
-        log_error("Failed to allocate encoder context for %s", stream_name);
-        goto cleanup;
-    }
-
-    // Set encoder parameters
-    audio_transcoders[slot].encoder_ctx->sample_fmt = AV_SAMPLE_FMT_FLTP; // AAC requires float planar format
-    audio_transcoders[slot].encoder_ctx->sample_rate = audio_transcoders[slot].decoder_ctx->sample_rate;
-
-    // Handle channel layout using the newer FFmpeg API (5.0+)
-#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(59, 37, 100)
-    // Copy channel layout from decoder to encoder
-    av_channel_layout_copy(&audio_transcoders[slot].encoder_ctx->ch_layout,
-                          &audio_transcoders[slot].decoder_ctx->ch_layout);
-
-    // If channel layout is not set, default to stereo
-    if (audio_transcoders[slot].encoder_ctx->ch_layout.nb_channels == 0) {
-        av_channel_layout_default(&audio_transcoders[slot].encoder_ctx->ch_layout, 2); // Default to stereo
-    }
-#else
-    // For older FFmpeg versions
-    audio_transcoders[slot].encoder_ctx->channels = audio_transcoders[slot].decoder_ctx->channels;
-    audio_transcoders[slot].encoder_ctx->channel_layout = av_get_default_channel_layout(audio_transcoders[slot].decoder_ctx->channels);
-#endif
-
-    audio_transcoders[slot].encoder_ctx->bit_rate = 128000; // 128 kbps, a good default for AAC
-    audio_transcoders[slot].encoder_ctx->time_base = (AVRational){1, audio_transcoders[slot].encoder_ctx->sample_rate};
-
-    // Open encoder
-    ret = avcodec_open2(audio_transcoders[slot].encoder_ctx, encoder, NULL);
-    if (ret < 0) {
-        log_ffmpeg_error(ret, "Failed to open AAC encoder");
-        goto cleanup;
-    }
-
-    // Allocate frame and packets
-    audio_transcoders[slot].frame = av_frame_alloc();
-    if (!audio_transcoders[slot].frame) {
-        log_error("Failed to allocate frame for %s", stream_name);
-        goto cleanup;
-    }
-
-    audio_transcoders[slot].in_pkt = av_packet_alloc();
-    if (!audio_transcoders[slot].in_pkt) {
-        log_error("Failed to allocate input packet for %s", stream_name);
-        goto cleanup;
+    audio_transcoder_t *tc = audio_transcoder_create(stream_name, codec_params, time_base);
+    if (tc) {
+        audio_transcoders[slot] = tc;
+        strncpy(audio_transcoder_stream_names[slot], stream_name, MAX_STREAM_NAME - 1);
+        audio_transcoder_stream_names[slot][MAX_STREAM_NAME - 1] = '\0';
     }
 
-    audio_transcoders[slot].out_pkt = av_packet_alloc();
-    if (!audio_transcoders[slot].out_pkt) {
-        log_error("Failed to allocate output packet for %s", stream_name);
-        goto cleanup;
-    }
-
-    // Mark as initialized
-    audio_transcoders[slot].initialized = 1;
-
-    // Store stream name
-    strncpy(audio_transcoder_stream_names[slot], stream_name, MAX_STREAM_NAME - 1);
-    audio_transcoder_stream_names[slot][MAX_STREAM_NAME - 1] = '\0';
-
-    log_info("Successfully initialized audio transcoder from μ-law to AAC for %s", stream_name);
-
-#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(59, 37, 100)
-    log_info("Sample rate: %d, Channels: %d, Bit rate: %ld",
-            audio_transcoders[slot].encoder_ctx->sample_rate,
-            audio_transcoders[slot].encoder_ctx->ch_layout.nb_channels,
-            audio_transcoders[slot].encoder_ctx->bit_rate);
-#else
-    log_info("Sample rate: %d, Channels: %d, Bit rate: %ld",
-            audio_transcoders[slot].encoder_ctx->sample_rate,
-            audio_transcoders[slot].encoder_ctx->channels,
-            audio_transcoders[slot].encoder_ctx->bit_rate);
-#endif
-
     pthread_mutex_unlock(&audio_transcoder_mutex);
-    return slot;
-
-cleanup:
-    if (audio_transcoders[slot].decoder_ctx) {
-        avcodec_free_context(&audio_transcoders[slot].decoder_ctx);
-        audio_transcoders[slot].decoder_ctx = NULL;
-    }
-
-    if (audio_transcoders[slot].encoder_ctx) {
-        avcodec_free_context(&audio_transcoders[slot].encoder_ctx);
-        audio_transcoders[slot].encoder_ctx = NULL;
-    }
-
-    if (audio_transcoders[slot].frame) {
-        av_frame_free(&audio_transcoders[slot].frame);
-        audio_transcoders[slot].frame = NULL;
-    }
-
-    if (audio_transcoders[slot].in_pkt) {
-        av_packet_free(&audio_transcoders[slot].in_pkt);
-        audio_transcoders[slot].in_pkt = NULL;
-    }
-
-    if (audio_transcoders[slot].out_pkt) {
-        av_packet_free(&audio_transcoders[slot].out_pkt);
-        audio_transcoders[slot].out_pkt = NULL;
-    }
-
-    audio_transcoders[slot].initialized = 0;
-    audio_transcoder_stream_names[slot][0] = '\0';
-
-    pthread_mutex_unlock(&audio_transcoder_mutex);
-    return -1;
+    return tc;
 }
 
 /**
@@ -243,35 +91,8 @@ void cleanup_audio_transcoder(const char *stream_name) {
     pthread_mutex_lock(&audio_transcoder_mutex);
 
     for (int i = 0; i < MAX_STREAMS; i++) {
-        if (audio_transcoder_stream_names[i][0] != '\0' &&
-            strcmp(audio_transcoder_stream_names[i], stream_name) == 0) {
-            // Found the transcoder for this stream
-            if (audio_transcoders[i].decoder_ctx) {
-                avcodec_free_context(&audio_transcoders[i].decoder_ctx);
-                audio_transcoders[i].decoder_ctx = NULL;
-            }
-
-            if (audio_transcoders[i].encoder_ctx) {
-                avcodec_free_context(&audio_transcoders[i].encoder_ctx);
-                audio_transcoders[i].encoder_ctx = NULL;
-            }
-
-            if (audio_transcoders[i].frame) {
-                av_frame_free(&audio_transcoders[i].frame);
-                audio_transcoders[i].frame = NULL;
-            }
-
-            if (audio_transcoders[i].in_pkt) {
-                av_packet_free(&audio_transcoders[i].in_pkt);
-                audio_transcoders[i].in_pkt = NULL;
-            }
-
-            if (audio_transcoders[i].out_pkt) {
-                av_packet_free(&audio_transcoders[i].out_pkt);
-                audio_transcoders[i].out_pkt = NULL;
-            }
-
-            audio_transcoders[i].initialized = 0;
+        if (audio_transcoders[i] && strcmp(audio_transcoder_stream_names[i], stream_name) == 0) {
+            audio_transcoder_free(&audio_transcoders[i]);
             audio_transcoder_stream_names[i][0] = '\0';
 
             log_info("Cleaned up audio transcoder for stream %s", stream_name);
@@ -283,253 +104,41 @@ void cleanup_audio_transcoder(const char *stream_name) {
 }
 
 /**
- * Transcode an audio packet from μ-law to AAC
- *
- * @param stream_name Name of the stream
- * @param in_pkt Input packet (μ-law)
- * @param out_pkt Output packet (AAC) - must be allocated by caller
- * @param input_stream Original input stream
- * @return 0 on success, negative on error
- */
-int transcode_audio_packet(const char *stream_name,
-                          const AVPacket *in_pkt,
-                          AVPacket *out_pkt,
-                          const AVStream *input_stream) {
-    int ret = 0;
-    int transcoder_idx = -1;
-    int got_output = 0;
-
-    // Find the transcoder for this stream
-    for (int i = 0; i < MAX_STREAMS; i++) {
-        if (audio_transcoders[i].initialized &&
-            audio_transcoder_stream_names[i][0] != '\0' &&
-            strcmp(audio_transcoder_stream_names[i], stream_name) == 0) {
-            transcoder_idx = i;
-            break;
-        }
-    }
-
-    if (transcoder_idx == -1) {
-        // Initialize a new transcoder
-        transcoder_idx = init_audio_transcoder(stream_name,
-                                             input_stream->codecpar,
-                                             &input_stream->time_base);
-        if (transcoder_idx == -1) {
-            log_error("Failed to initialize audio transcoder for %s", stream_name);
-            return -1;
-        }
-    }
-
-    // Copy input packet to our internal packet
-    av_packet_unref(audio_transcoders[transcoder_idx].in_pkt);
-    ret = av_packet_ref(audio_transcoders[transcoder_idx].in_pkt, in_pkt);
-    if (ret < 0) {
-        log_ffmpeg_error(ret, "Failed to copy input packet");
-        return ret;
-    }
-
-    // Send packet to decoder
-    ret = avcodec_send_packet(audio_transcoders[transcoder_idx].decoder_ctx,
-                             audio_transcoders[transcoder_idx].in_pkt);
-    if (ret < 0) {
-        log_ffmpeg_error(ret, "Failed to send packet to decoder");
-        return ret;
-    }
-
-    // Receive frame from decoder
-    ret = avcodec_receive_frame(audio_transcoders[transcoder_idx].decoder_ctx,
-                               audio_transcoders[transcoder_idx].frame);
-    if (ret < 0) {
-        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
-            // Need more input or end of file, not an error
-            return 0;
-        }
-        log_ffmpeg_error(ret, "Failed to receive frame from decoder");
-        return ret;
-    }
-
-    // Send frame to encoder
-    ret = avcodec_send_frame(audio_transcoders[transcoder_idx].encoder_ctx,
-                            audio_transcoders[transcoder_idx].frame);
-    if (ret < 0) {
-        log_ffmpeg_error(ret, "Failed to send frame to encoder");
-        return ret;
-    }
-
-    // Receive packet from encoder
-    av_packet_unref(audio_transcoders[transcoder_idx].out_pkt);
-    ret = avcodec_receive_packet(audio_transcoders[transcoder_idx].encoder_ctx,
-                                audio_transcoders[transcoder_idx].out_pkt);
-    if (ret < 0) {
-        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
-            // Need more input or end of file, not an error
-            return 0;
-        }
-        log_ffmpeg_error(ret, "Failed to receive packet from encoder");
-        return ret;
-    }
-
-    // Copy output packet to caller's packet
-    av_packet_unref(out_pkt);
-    ret = av_packet_ref(out_pkt, audio_transcoders[transcoder_idx].out_pkt);
-    if (ret < 0) {
-        log_ffmpeg_error(ret, "Failed to copy output packet");
-        return ret;
-    }
-
-    // Set output packet time base to match the encoder's time base
-    out_pkt->time_base = audio_transcoders[transcoder_idx].encoder_ctx->time_base;
-
-    // Set output packet stream index to match the input packet
-    out_pkt->stream_index = in_pkt->stream_index;
-
-    return 0;
-}
-
-/**
- * Transcode audio from μ-law to AAC format
+ * Set up transcoding of G.711 audio to AAC
+ * The stream's transcoder is created here, so the parameters match the
+ * packets it produces later.
  *
- * @param codec_params Original codec parameters (μ-law)
+ * @param codec_params Original codec parameters (G.711)
  * @param time_base Time base of the original stream
- * @param stream_name Name of the stream (for logging)
+ * @param stream_name Name of the stream
  * @param transcoded_params Output parameter to store the transcoded codec parameters
  * @return 0 on success, negative on error
  */
-static int transcode_mulaw_to_aac(const AVCodecParameters *codec_params,
+static int transcode_g711_to_aac(const AVCodecParameters *codec_params,
                                  const AVRational *time_base,
                                  const char *stream_name,
                                  AVCodecParameters **transcoded_params) {
-    int ret = 0;
-    AVCodecContext *decoder_ctx = NULL;
-    AVCodecContext *encoder_ctx = NULL;
-    const AVCodec *decoder = NULL;
-    const AVCodec *encoder = NULL;
-    AVFrame *frame = NULL;
-    AVPacket *pkt = NULL;
-
-    // Allocate output codec parameters
-    *transcoded_params = avcodec_parameters_alloc();
-    if (!*transcoded_params) {
-        log_error("Failed to allocate transcoded codec parameters for %s",
-                stream_name ? stream_name : "unknown");
-        ret = AVERROR(ENOMEM);
-        goto cleanup;
-    }
-
-    // Find the μ-law decoder
-    decoder = avcodec_find_decoder(codec_params->codec_id);
-    if (!decoder) {
-        log_error("Failed to find decoder for μ-law audio in %s",
-                stream_name ? stream_name : "unknown");
-        ret = AVERROR_DECODER_NOT_FOUND;
-        goto cleanup;
-    }
-
-    // Find the AAC encoder
-    encoder = avcodec_find_encoder(AV_CODEC_ID_AAC);
-    if (!encoder) {
-        log_error("Failed to find AAC encoder for %s",
-                stream_name ? stream_name : "unknown");
-        ret = AVERROR_ENCODER_NOT_FOUND;
-        goto cleanup;
-    }
-
-    // Create decoder context
-    decoder_ctx = avcodec_alloc_context3(decoder);
-    if (!decoder_ctx) {
-        log_error("Failed to allocate decoder context for %s",
-                stream_name ? stream_name : "unknown");
-        ret = AVERROR(ENOMEM);
-        goto cleanup;
-    }
+    *transcoded_params = NULL;
 
-    // Copy parameters to decoder context
-    ret = avcodec_parameters_to_context(decoder_ctx, codec_params);
-    if (ret < 0) {
-        log_ffmpeg_error(ret, "Failed to copy parameters to decoder context");
-        goto cleanup;
+    audio_transcoder_t *tc = get_audio_transcoder(stream_name, codec_params, *time_base);
+    if (!tc) {
+        log_error("Failed to set up audio transcoding for %s", stream_name ? stream_name : "unknown");
+        return AVERROR(EINVAL);
     }
 
-    // Set time base
-    decoder_ctx->time_base = *time_base;
-
-    // Open decoder
-    ret = avcodec_open2(decoder_ctx, decoder, NULL);
-    if (ret < 0) {
-        log_ffmpeg_error(ret, "Failed to open μ-law decoder");
-        goto cleanup;
-    }
-
-    // Create encoder context
-    encoder_ctx = avcodec_alloc_context3(encoder);
-    if (!encoder_ctx) {
-        log_error("Failed to allocate encoder context for %s",
-                stream_name ? stream_name : "unknown");
-        ret = AVERROR(ENOMEM);
-        goto cleanup;
-    }
-
-    // Set encoder parameters
-    encoder_ctx->sample_fmt = AV_SAMPLE_FMT_FLTP; // AAC requires float planar format
-    encoder_ctx->sample_rate = decoder_ctx->sample_rate;
-
-    // Handle channel layout using the newer FFmpeg API (5.0+)
-#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(59, 37, 100)
-    // Copy channel layout from decoder to encoder
-    av_channel_layout_copy(&encoder_ctx->ch_layout, &decoder_ctx->ch_layout);
-
-    // If channel layout is not set, default to stereo
-    if (encoder_ctx->ch_layout.nb_channels == 0) {
-        av_channel_layout_default(&encoder_ctx->ch_layout, 2); // Default to stereo
-    }
-#else
-    // For older FFmpeg versions
-    encoder_ctx->channels = decoder_ctx->channels;
-    encoder_ctx->channel_layout = av_get_default_channel_layout(decoder_ctx->channels);
-#endif
-
-    encoder_ctx->bit_rate = 128000; // 128 kbps, a good default for AAC
-    encoder_ctx->time_base = (AVRational){1, encoder_ctx->sample_rate};
-
-    // Open encoder
-    ret = avcodec_open2(encoder_ctx, encoder, NULL);
-    if (ret < 0) {
-        log_ffmpeg_error(ret, "Failed to open AAC encoder");
-        goto cleanup;
+    *transcoded_params = avcodec_parameters_alloc();
+    if (!*transcoded_params) {
+        return AVERROR(ENOMEM);
     }
 
-    // Get the encoder parameters
-    ret = avcodec_parameters_from_context(*transcoded_params, encoder_ctx);
+    int ret = avcodec_parameters_copy(*transcoded_params, audio_transcoder_get_parameters(tc));
     if (ret < 0) {
-        log_ffmpeg_error(ret, "Failed to get parameters from encoder context");
-        goto cleanup;
-    }
-
-    log_info("Successfully configured transcoding from μ-law to AAC for %s",
-            stream_name ? stream_name : "unknown");
-
-#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(59, 37, 100)
-    log_info("Sample rate: %d, Channels: %d, Bit rate: %ld",
-            encoder_ctx->sample_rate, encoder_ctx->ch_layout.nb_channels, encoder_ctx->bit_rate);
-#else
-    log_info("Sample rate: %d, Channels: %d, Bit rate: %ld",
-            encoder_ctx->sample_rate, encoder_ctx->channels, encoder_ctx->bit_rate);
-#endif
-
-    ret = 0; // Success
-
-cleanup:
-    if (decoder_ctx) avcodec_free_context(&decoder_ctx);
-    if (encoder_ctx) avcodec_free_context(&encoder_ctx);
-    if (frame) av_frame_free(&frame);
-    if (pkt) av_packet_free(&pkt);
-
-    if (ret < 0 && *transcoded_params) {
+        log_ffmpeg_error(ret, "Failed to copy transcoded audio parameters");
         avcodec_parameters_free(transcoded_params);
-        *transcoded_params = NULL;
+        return ret;
     }
 
-    return ret;
+    return 0;
 }
 
 /**
@@ -572,74 +181,6 @@ static bool is_audio_codec_compatible_with_mp4(enum AVCodecID codec_id, const ch
     return is_compatible;
 }
 
-/**
- * Apply h264_mp4toannexb bitstream filter to convert H.264 stream from MP4 format to Annex B format
- * This is needed for some RTSP cameras that send H.264 in MP4 format instead of Annex B format
- *
- * @param packet The packet to convert
- * @param codec_id The codec ID of the stream
- * @return 0 on success, negative on error
- */
-int apply_h264_annexb_filter(AVPacket *packet, enum AVCodecID codec_id) {
-    // Only apply to H.264 streams
-    if (codec_id != AV_CODEC_ID_H264) {
-        return 0;
-    }
-
-    // Check if the packet already has start codes (Annex B format)
-    if (packet->size >= 4 &&
-        packet->data[0] == 0x00 &&
-        packet->data[1] == 0x00 &&
-        packet->data[2] == 0x00 &&
-        packet->data[3] == 0x01) {
-        // Already in Annex B format
-        return 0;
-    }
-
-    // MEMORY LEAK FIX: Use a more robust approach with AVPacket functions
-    // This avoids potential memory leaks by using FFmpeg's memory management
-
-    // Create a new packet for the filtered data
-    AVPacket *new_pkt = av_packet_alloc();
-    if (!new_pkt) {
-        return AVERROR(ENOMEM);
-    }
-
-    // Allocate a new buffer with space for the start code + original data
-    int new_size = packet->size + 4;
-    int ret = av_new_packet(new_pkt, new_size);
-    if (ret < 0) {
-        av_packet_free(&new_pkt);
-        return ret;
-    }
-
-    // Add start code
-    new_pkt->data[0] = 0x00;
-    new_pkt->data[1] = 0x00;
-    new_pkt->data[2] = 0x00;
-    new_pkt->data[3] = 0x01;
-
-    // Copy the packet data
-    memcpy(new_pkt->data + 4, packet->data, packet->size);
-
-    // Copy other packet properties
-    new_pkt->pts = packet->pts;
-    new_pkt->dts = packet->dts;
-    new_pkt->flags = packet->flags;
-    new_pkt->stream_index = packet->stream_index;
-
-    // Unref the original packet
-    av_packet_unref(packet);
-
-    // Move the new packet to the original packet
-    av_packet_move_ref(packet, new_pkt);
-
-    // Free the new packet
-    av_packet_free(&new_pkt);
-
-    return 0;
-}
-
 /**
  * Enhanced MP4 writer initialization with better path handling and logging
  * and proper audio stream handling
@@ -804,20 +345,20 @@ int mp4_writer_initialize(mp4_writer_t *writer, const AVPacket *pkt, const AVStr
         bool is_compatible = is_audio_codec_compatible_with_mp4(input_stream->codecpar->codec_id, &codec_name);
 
         if (!is_compatible) {
-            // For incompatible codecs, attempt transcoding if it's μ-law
-            if (input_stream->codecpar->codec_id == AV_CODEC_ID_PCM_MULAW) {
+            // For incompatible codecs, attempt transcoding if it's G.711
+            if (audio_transcode_needed(input_stream->codecpar->codec_id)) {
                 log_info("Attempting to transcode %s audio to AAC for MP4 compatibility in stream %s", 
                         codec_name, writer->stream_name ? writer->stream_name : "unknown");
                 
-                // Try to transcode μ-law to AAC
+                // Try to transcode G.711 to AAC
                 AVCodecParameters *transcoded_params = NULL;
-                int transcode_ret = transcode_mulaw_to_aac(input_stream->codecpar, 
+                int transcode_ret = transcode_g711_to_aac(input_stream->codecpar, 
                                                          &input_stream->time_base, 
                                                          writer->stream_name, 
                                                          &transcoded_params);
                 
                 if (transcode_ret >= 0 && transcoded_params) {
-                    log_info("Successfully transcoded μ-law audio to AAC for stream %s", 
+                    log_info("Successfully transcoded G.711 audio to AAC for stream %s", 
                             writer->stream_name ? writer->stream_name : "unknown");
                     
                     // Create a dummy video stream first (MP4 expects video to be the first stream)
@@ -1223,18 +764,18 @@ int mp4_writer_add_audio_stream(mp4_writer_t *writer, const AVCodecParameters *c
     bool is_compatible = is_audio_codec_compatible_with_mp4(codec_params->codec_id, &codec_name);
 
     if (!is_compatible) {
-        // For incompatible codecs, attempt transcoding if it's μ-law
-        if (codec_params->codec_id == AV_CODEC_ID_PCM_MULAW) {
+        // For incompatible codecs, attempt transcoding if it's G.711
+        if (audio_transcode_needed(codec_params->codec_id)) {
             log_info("Attempting to transcode %s audio to AAC for MP4 compatibility in stream %s", 
                     codec_name, writer->stream_name ? writer->stream_name : "unknown");
             
-            // Try to transcode μ-law to AAC
+            // Try to transcode G.711 to AAC
             AVCodecParameters *transcoded_params = NULL;
-            int transcode_ret = transcode_mulaw_to_aac(codec_params, &safe_time_base, 
+            int transcode_ret = transcode_g711_to_aac(codec_params, &safe_time_base, 
                                                      writer->stream_name, &transcoded_params);
             
             if (transcode_ret >= 0 && transcoded_params) {
-                log_info("Successfully transcoded μ-law audio to AAC for stream %s", 
+                log_info("Successfully transcoded G.711 audio to AAC for stream %s", 
                         writer->stream_name ? writer->stream_name : "unknown");
                 
                 // Free the original codec parameters
@@ -1244,7 +785,7 @@ int mp4_writer_add_audio_stream(mp4_writer_t *writer, const AVCodecParameters *c
                 local_codec_params = transcoded_params;
                 
                 // Update codec name for logging
-                codec_name = "AAC (transcoded from μ-law)";
+                codec_name = "AAC (transcoded from G.711)";
                 is_compatible = true;
             } else {
                 log_error("Failed to transcode %s audio to AAC: %d", codec_name, transcode_ret);
@@ -0,0 +1,248 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "core/logger.h"
+#include "core/config.h"
+#include "database/db_detections.h"
+#include "video/object_tracker.h"
+
+// Boxes of the same label overlapping this much are the same object
+#define TRACK_MATCH_IOU 0.3f
+
+// Otherwise centroids this close (fraction of the frame) are the same object
+#define TRACK_MATCH_DISTANCE 0.1f
+
+// A track whose box overlaps its last reported box less than this has moved
+#define TRACK_MOVE_IOU 0.6f
+
+// Tracks not matched for this long have left the scene
+#define TRACK_LOST_SECONDS 10
+
+typedef struct {
+    int id;                     // 0 = free slot
+    detection_t box;            // Last matched detection
+    detection_t reported;       // Box when the track was last reported
+    time_t last_seen;
+} track_t;
+
+typedef struct {
+    char stream_name[MAX_STREAM_NAME];
+    track_t tracks[MAX_TRACKS];
+} stream_tracker_t;
+
+static stream_tracker_t *trackers[MAX_STREAMS];
+static pthread_mutex_t trackers_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Track IDs are unique across streams and restarts
+static int next_track_id = 0;
+
+static float box_iou(const detection_t *a, const detection_t *b) {
+    float x0 = fmaxf(a->x, b->x);
+    float y0 = fmaxf(a->y, b->y);
+    float x1 = fminf(a->x + a->width, b->x + b->width);
+    float y1 = fminf(a->y + a->height, b->y + b->height);
+    if (x1 <= x0 || y1 <= y0) {
+        return 0.0f;
+    }
+
+    float inter = (x1 - x0) * (y1 - y0);
+    float uni = a->width * a->height + b->width * b->height - inter;
+    return uni > 0.0f ? inter / uni : 0.0f;
+}
+
+/**
+ * How well a detection matches a track, 0 if it does not
+ * Overlapping boxes always rank above centroid-only matches.
+ */
+static float match_score(const track_t *track, const detection_t *det) {
+    if (strcmp(track->box.label, det->label) != 0) {
+        return 0.0f;
+    }
+
+    float iou = box_iou(&track->box, det);
+    if (iou >= TRACK_MATCH_IOU) {
+        return 1.0f + iou;
+    }
+
+    float dx = (track->box.x + track->box.width / 2.0f) - (det->x + det->width / 2.0f);
+    float dy = (track->box.y + track->box.height / 2.0f) - (det->y + det->height / 2.0f);
+    float distance = sqrtf(dx * dx + dy * dy);
+    if (distance < TRACK_MATCH_DISTANCE) {
+        return 1.0f - distance / TRACK_MATCH_DISTANCE;
+    }
+    return 0.0f;
+}
+
+/**
+ * Find or create the tracker of a stream
+ * Must be called with the trackers mutex held.
+ */
+static stream_tracker_t *get_tracker(const char *stream_name) {
+    int free_slot = -1;
+    for (int i = 0; i < MAX_STREAMS; i++) {
+        if (trackers[i] && strcmp(trackers[i]->stream_name, stream_name) == 0) {
+            return trackers[i];
+        }
+        if (!trackers[i] && free_slot < 0) {
+            free_slot = i;
+        }
+    }
+    if (free_slot < 0) {
+        return NULL;
+    }
+
+    stream_tracker_t *tracker = calloc(1, sizeof(stream_tracker_t));
+    if (!tracker) {
+        return NULL;
+    }
+    strncpy(tracker->stream_name, stream_name, MAX_STREAM_NAME - 1);
+    tracker->stream_name[MAX_STREAM_NAME - 1] = '\0';
+    trackers[free_slot] = tracker;
+    return tracker;
+}
+
+static void end_track(track_t *track, track_update_t *update) {
+    if (update->ended.count < MAX_DETECTIONS) {
+        update->ended_at[update->ended.count] = track->last_seen;
+        update->ended.detections[update->ended.count++] = track->box;
+    }
+    track->id = 0;
+}
+
+static void report_track(track_t *track, track_update_t *update) {
+    if (update->changes.count < MAX_DETECTIONS) {
+        update->changes.detections[update->changes.count++] = track->box;
+    }
+    track->reported = track->box;
+}
+
+int object_tracker_update(const char *stream_name, detection_result_t *detections,
+                          time_t frame_time, track_update_t *update) {
+    if (!stream_name || !detections || !update) {
+        return -1;
+    }
+    memset(update, 0, sizeof(track_update_t));
+
+    pthread_mutex_lock(&trackers_mutex);
+
+    stream_tracker_t *tracker = get_tracker(stream_name);
+    if (!tracker) {
+        pthread_mutex_unlock(&trackers_mutex);
+        log_error("No tracker available for stream %s", stream_name);
+        return -1;
+    }
+
+    if (next_track_id == 0) {
+        int max_id = get_max_detection_track_id();
+        next_track_id = (max_id > 0 ? max_id : 0) + 1;
+    }
+
+    // Tracks not seen for a while have left
+    for (int t = 0; t < MAX_TRACKS; t++) {
+        track_t *track = &tracker->tracks[t];
+        if (track->id && frame_time - track->last_seen > TRACK_LOST_SECONDS) {
+            end_track(track, update);
+        }
+    }
+
+    // Greedy matching, best pair first
+    bool det_matched[MAX_DETECTIONS] = {false};
+    bool track_matched[MAX_TRACKS] = {false};
+    int count = detections->count < MAX_DETECTIONS ? detections->count : MAX_DETECTIONS;
+    for (;;) {
+        float best = 0.0f;
+        int best_det = -1, best_track = -1;
+        for (int d = 0; d < count; d++) {
+            if (det_matched[d]) {
+                continue;
+            }
+            for (int t = 0; t < MAX_TRACKS; t++) {
+                if (!tracker->tracks[t].id || track_matched[t]) {
+                    continue;
+                }
+                float score = match_score(&tracker->tracks[t], &detections->detections[d]);
+                if (score > best) {
+                    best = score;
+                    best_det = d;
+                    best_track = t;
+                }
+            }
+        }
+        if (best_det < 0) {
+            break;
+        }
+
+        track_t *track = &tracker->tracks[best_track];
+        det_matched[best_det] = true;
+        track_matched[best_track] = true;
+
+        detections->detections[best_det].track_id = track->id;
+        track->box = detections->detections[best_det];
+        track->last_seen = frame_time;
+        if (box_iou(&track->box, &track->reported) < TRACK_MOVE_IOU) {
+            report_track(track, update);
+        }
+    }
+
+    // New objects start tracks, taking the slot of the longest unseen track if needed
+    for (int d = 0; d < count; d++) {
+        if (det_matched[d]) {
+            continue;
+        }
+
+        int slot = -1;
+        for (int t = 0; t < MAX_TRACKS; t++) {
+            if (!tracker->tracks[t].id) {
+                slot = t;
+                break;
+            }
+            if (!track_matched[t] && (slot < 0 || tracker->tracks[t].last_seen < tracker->tracks[slot].last_seen)) {
+                slot = t;
+            }
+        }
+        if (slot < 0) {
+            detections->detections[d].track_id = 0;
+            continue;
+        }
+
+        track_t *track = &tracker->tracks[slot];
+        if (track->id) {
+            end_track(track, update);
+        }
+        track->id = next_track_id++;
+        track_matched[slot] = true;
+        detections->detections[d].track_id = track->id;
+        track->box = detections->detections[d];
+        track->last_seen = frame_time;
+        report_track(track, update);
+        update->new_tracks++;
+    }
+
+    pthread_mutex_unlock(&trackers_mutex);
+
+    if (update->new_tracks > 0 || update->ended.count > 0) {
+        log_debug("[Stream %s] Tracks: %d new, %d moved, %d ended", stream_name, update->new_tracks,
+                 update->changes.count - update->new_tracks, update->ended.count);
+    }
+    return 0;
+}
+
+void object_tracker_reset(const char *stream_name) {
+    if (!stream_name) {
+        return;
+    }
+
+    pthread_mutex_lock(&trackers_mutex);
+    for (int i = 0; i < MAX_STREAMS; i++) {
+        if (trackers[i] && strcmp(trackers[i]->stream_name, stream_name) == 0) {
+            free(trackers[i]);
+            trackers[i] = NULL;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&trackers_mutex);
+}
@@ -18,13 +18,29 @@
 #include "core/config.h"
 #include "core/shutdown_coordinator.h"
 #include "video/onvif_detection.h"
+#include "video/onvif_xml.h"
+#include "video/dns_cache.h"
 #include "video/detection_result.h"
 #include "database/db_detections.h"
 
+// Seconds a PullMessages request waits on the camera for events
+#define PULL_TIMEOUT_SECONDS 10
+
+// Termination time requested for subscriptions, and how early they are renewed
+#define SUBSCRIPTION_SECONDS 3600
+#define RENEW_MARGIN_SECONDS 60
+
+// Seconds before a failed request to a camera is retried
+#define RETRY_SECONDS 10
+
+// Subscriptions nobody asked about for this long are dropped
+#define IDLE_SECONDS 300
+
 // Global variables
 static bool initialized = false;
-static CURL *curl_handle = NULL;
-static pthread_mutex_t curl_mutex = PTHREAD_MUTEX_INITIALIZER;
+static CURLM *multi_handle = NULL;
+static pthread_t event_thread;
+static volatile bool event_thread_running = false;
 
 // Structure to hold memory for curl response
 typedef struct {
@@ -32,6 +48,14 @@ typedef struct {
     size_t size;
 } memory_struct_t;
 
+// Request a subscription has in flight on the event thread
+typedef enum {
+    ONVIF_OP_NONE = 0,
+    ONVIF_OP_CREATE,                // CreatePullPointSubscription
+    ONVIF_OP_PULL,                  // Long-poll PullMessages
+    ONVIF_OP_RENEW                  // Renew before the termination time
+} onvif_op_t;
+
 // Structure to hold ONVIF subscription information
 typedef struct {
     char camera_url[512];           // URL of the camera (used as the key for lookup)
@@ -40,7 +64,17 @@ typedef struct {
     char password[64];              // Password for authentication
     time_t creation_time;
     time_t expiration_time;
-    bool active;
+    bool active;                    // Subscription exists on the camera
+    bool in_use;                    // Slot holds a camera
+    bool motion_pending;            // Motion arrived since the last detect_motion_onvif call
+    int failures;                   // Consecutive failed requests
+    time_t retry_after;             // No request before this time after a failure
+    time_t last_used;               // Last detect_motion_onvif call for the camera
+    onvif_op_t op;                  // Request in flight, ONVIF_OP_NONE if idle
+    CURL *easy;                     // Reused for every request to the camera
+    struct curl_slist *headers;
+    struct curl_slist *resolve;     // Cached address of the camera for CURLOPT_RESOLVE
+    memory_struct_t response;
 } onvif_subscription_t;
 
 // Hash map to store subscriptions by URL
@@ -200,246 +234,378 @@ static char *create_onvif_request(const char *username, const char *password, co
     return soap_request;
 }
 
-// Send ONVIF request and get response
-static char *send_onvif_request(const char *url, const char *username, const char *password, 
-                               const char *request_body, const char *service) {
-    if (!initialized || !curl_handle) {
-        log_error("ONVIF detection system not initialized");
-        return NULL;
-    }
-
-    pthread_mutex_lock(&curl_mutex);
+// Extract subscription address from response
+static char *extract_subscription_address(const char *response) {
+    if (!response) return NULL;
 
-    // Create full URL
-    char full_url[512];
-    snprintf(full_url, sizeof(full_url), "%s/onvif/%s", url, service);
-    log_info("ONVIF Detection: Sending request to %s", full_url);
+    char *address = (char *)malloc(MAX_URL_LENGTH);
+    if (!address) return NULL;
 
-    // Create SOAP request
-    char *soap_request = create_onvif_request(username, password, request_body);
-    if (!soap_request) {
-        log_error("Failed to create ONVIF request");
-        pthread_mutex_unlock(&curl_mutex);
+    if (!onvif_xml_find_text(response, strlen(response), "SubscriptionReference/Address",
+                             address, MAX_URL_LENGTH) || !address[0]) {
+        free(address);
         return NULL;
     }
+    return address;
+}
 
-    // Set up curl
-    curl_easy_setopt(curl_handle, CURLOPT_URL, full_url);
-    curl_easy_setopt(curl_handle, CURLOPT_POSTFIELDS, soap_request);
-    curl_easy_setopt(curl_handle, CURLOPT_POSTFIELDSIZE, strlen(soap_request));
+// Extract service name from subscription address
+static char *extract_service_name(const char *subscription_address) {
+    if (!subscription_address) return NULL;
 
-    // Set headers
-    struct curl_slist *headers = NULL;
-    headers = curl_slist_append(headers, "Content-Type: application/soap+xml; charset=utf-8");
-    curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, headers);
+    // Find the last slash
+    const char *last_slash = strrchr(subscription_address, '/');
+    if (!last_slash) return NULL;
 
-    // Set up response buffer
-    memory_struct_t chunk;
-    chunk.memory = malloc(1);
-    chunk.size = 0;
+    // Extract the service name
+    char *service = strdup(last_slash + 1);
+    return service;
+}
 
-    curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, write_memory_callback);
-    curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, (void *)&chunk);
-    curl_easy_setopt(curl_handle, CURLOPT_TIMEOUT, 10);
+// Check for motion events in ONVIF response
+static bool has_motion_event(const char *response) {
+    if (!response) return false;
 
-    // Perform request
-    CURLcode res = curl_easy_perform(curl_handle);
+    onvif_xml_reader_t reader;
+    onvif_xml_event_t event;
+    char topic[256];
 
-    // Clean up request
-    free(soap_request);
-    curl_slist_free_all(headers);
+    // Only the topics of the notifications matter, the rest is skipped
+    onvif_xml_init(&reader, response, strlen(response));
+    while ((event = onvif_xml_next(&reader)) != ONVIF_XML_EOF && event != ONVIF_XML_ERROR) {
+        if (event != ONVIF_XML_TEXT || !onvif_xml_path_is(&reader, "NotificationMessage/Topic")) {
+            continue;
+        }
+        onvif_xml_copy_text(&reader, topic, sizeof(topic));
 
-    // Check for errors
-    if (res != CURLE_OK) {
-        log_error("ONVIF Detection: curl_easy_perform() failed: %s", curl_easy_strerror(res));
-        free(chunk.memory);
-        pthread_mutex_unlock(&curl_mutex);
-        return NULL;
+        // Check for different motion event patterns
+        if (strstr(topic, "RuleEngine/MotionDetector") ||
+            strstr(topic, "VideoAnalytics/Motion") ||
+            strstr(topic, "MotionAlarm")) {
+            return true;
+        }
     }
 
-    // Get HTTP response code
-    long http_code = 0;
-    curl_easy_getinfo(curl_handle, CURLINFO_RESPONSE_CODE, &http_code);
+    return false;
+}
 
-    if (http_code != 200) {
-        log_error("ONVIF request failed with HTTP code %ld", http_code);
-        free(chunk.memory);
-        pthread_mutex_unlock(&curl_mutex);
-        return NULL;
+
+/**
+ * Get the URL requests on an existing subscription are posted to
+ * Cameras return an absolute address; a bare path falls back to the
+ * camera's /onvif/ services.
+ */
+static void subscription_target_url(const onvif_subscription_t *sub, char *url, size_t size) {
+    if (strncmp(sub->subscription_address, "http://", 7) == 0 ||
+        strncmp(sub->subscription_address, "https://", 8) == 0) {
+        snprintf(url, size, "%s", sub->subscription_address);
+        return;
     }
 
-    pthread_mutex_unlock(&curl_mutex);
-    return chunk.memory;
+    char *service = extract_service_name(sub->subscription_address);
+    snprintf(url, size, "%s/onvif/%s", sub->camera_url, service ? service : "events_service");
+    free(service);
 }
 
-// Extract subscription address from response
-static char *extract_subscription_address(const char *response) {
-    if (!response) return NULL;
+/**
+ * Free the curl state of a subscription
+ * The handle must not be attached to the multi handle.
+ */
+static void release_subscription(onvif_subscription_t *sub) {
+    if (sub->easy) {
+        curl_easy_cleanup(sub->easy);
+        sub->easy = NULL;
+    }
+    if (sub->headers) {
+        curl_slist_free_all(sub->headers);
+        sub->headers = NULL;
+    }
+    if (sub->resolve) {
+        curl_slist_free_all(sub->resolve);
+        sub->resolve = NULL;
+    }
+    free(sub->response.memory);
+    sub->response.memory = NULL;
+    sub->response.size = 0;
+    sub->op = ONVIF_OP_NONE;
+}
 
-    // Try different namespace prefixes
-    const char *patterns[] = {
-        "<wsa:Address>", "</wsa:Address>",
-        "<wsa5:Address>", "</wsa5:Address>",
-        "<Address>", "</Address>"
-    };
+/**
+ * Start the next request for a subscription on the multi handle
+ * Must be called with the subscription mutex held.
+ */
+static int start_request(onvif_subscription_t *sub, time_t now) {
+    const char *request_body;
+    char url[512];
+
+    if (!sub->active) {
+        sub->op = ONVIF_OP_CREATE;
+        request_body =
+            "<CreatePullPointSubscription xmlns=\"http://www.onvif.org/ver10/events/wsdl\">\n"
+            "  <InitialTerminationTime>PT1H</InitialTerminationTime>\n"
+            "</CreatePullPointSubscription>";
+        snprintf(url, sizeof(url), "%s/onvif/events_service", sub->camera_url);
+    } else if (sub->expiration_time - now <= RENEW_MARGIN_SECONDS) {
+        sub->op = ONVIF_OP_RENEW;
+        request_body =
+            "<Renew xmlns=\"http://docs.oasis-open.org/wsn/b-2\">\n"
+            "  <TerminationTime>PT1H</TerminationTime>\n"
+            "</Renew>";
+        subscription_target_url(sub, url, sizeof(url));
+    } else {
+        // The camera holds the request until an event arrives or the timeout passes
+        sub->op = ONVIF_OP_PULL;
+        request_body =
+            "<PullMessages xmlns=\"http://www.onvif.org/ver10/events/wsdl\">\n"
+            "  <Timeout>PT10S</Timeout>\n"
+            "  <MessageLimit>100</MessageLimit>\n"
+            "</PullMessages>";
+        subscription_target_url(sub, url, sizeof(url));
+    }
+
+    // WS-Security digests are only valid once, so every request gets a fresh header
+    char *soap_request = create_onvif_request(sub->username, sub->password, request_body);
+    if (!soap_request) {
+        log_error("Failed to create ONVIF request for %s", sub->camera_url);
+        sub->op = ONVIF_OP_NONE;
+        return -1;
+    }
 
-    for (int i = 0; i < 3; i++) {
-        const char *start = strstr(response, patterns[i*2]);
-        const char *end = strstr(response, patterns[i*2+1]);
-        
-        if (start && end) {
-            start += strlen(patterns[i*2]);
-            int length = end - start;
-            
-            char *address = (char *)malloc(length + 1);
-            if (address) {
-                strncpy(address, start, length);
-                address[length] = '\0';
-                return address;
-            }
+    if (!sub->easy) {
+        sub->easy = curl_easy_init();
+        if (!sub->easy) {
+            log_error("Failed to initialize curl handle for %s", sub->camera_url);
+            free(soap_request);
+            sub->op = ONVIF_OP_NONE;
+            return -1;
         }
+        sub->headers = curl_slist_append(NULL, "Content-Type: application/soap+xml; charset=utf-8");
+    }
+
+    free(sub->response.memory);
+    sub->response.memory = malloc(1);
+    sub->response.size = 0;
+
+    // Resolving the camera here would stall every other subscription on this thread
+    char resolve_entry[320];
+    curl_slist_free_all(sub->resolve);
+    sub->resolve = NULL;
+    if (dns_cache_curl_entry(url, resolve_entry, sizeof(resolve_entry)) == 0) {
+        sub->resolve = curl_slist_append(NULL, resolve_entry);
+    }
+
+    curl_easy_setopt(sub->easy, CURLOPT_URL, url);
+    curl_easy_setopt(sub->easy, CURLOPT_RESOLVE, sub->resolve);
+    curl_easy_setopt(sub->easy, CURLOPT_COPYPOSTFIELDS, soap_request);
+    curl_easy_setopt(sub->easy, CURLOPT_HTTPHEADER, sub->headers);
+    curl_easy_setopt(sub->easy, CURLOPT_WRITEFUNCTION, write_memory_callback);
+    curl_easy_setopt(sub->easy, CURLOPT_WRITEDATA, (void *)&sub->response);
+    curl_easy_setopt(sub->easy, CURLOPT_PRIVATE, (void *)sub);
+    curl_easy_setopt(sub->easy, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(sub->easy, CURLOPT_TIMEOUT, (long)(PULL_TIMEOUT_SECONDS + 10));
+    free(soap_request);
+
+    if (curl_multi_add_handle(multi_handle, sub->easy) != CURLM_OK) {
+        log_error("Failed to queue ONVIF request for %s", sub->camera_url);
+        sub->op = ONVIF_OP_NONE;
+        return -1;
     }
 
-    return NULL;
+    log_debug("ONVIF Detection: Sending %s request to %s",
+              sub->op == ONVIF_OP_CREATE ? "subscribe" : sub->op == ONVIF_OP_RENEW ? "renew" : "pull", url);
+    return 0;
 }
 
-// Find or create subscription for a camera
-static onvif_subscription_t *get_subscription(const char *url, const char *username, const char *password) {
-    pthread_mutex_lock(&subscription_mutex);
+/**
+ * Handle the outcome of a finished request
+ * Must be called with the subscription mutex held.
+ */
+static void finish_request(onvif_subscription_t *sub, CURLcode res, time_t now) {
+    long http_code = 0;
+    curl_easy_getinfo(sub->easy, CURLINFO_RESPONSE_CODE, &http_code);
+    onvif_op_t op = sub->op;
+    sub->op = ONVIF_OP_NONE;
 
-    // Check if we already have a subscription for this URL
-    for (int i = 0; i < subscription_count; i++) {
-        if (strcmp(subscriptions[i].camera_url, url) == 0) {
-            // Check if subscription is still valid
-            time_t now;
-            time(&now);
-            
-            if (subscriptions[i].active && now < subscriptions[i].expiration_time) {
-                log_info("Reusing existing ONVIF subscription for %s", url);
-                pthread_mutex_unlock(&subscription_mutex);
-                return &subscriptions[i];
-            } else {
-                // Subscription expired, remove it
-                log_info("ONVIF subscription for %s expired, creating new one", url);
-                subscriptions[i].active = false;
+    if (res != CURLE_OK || http_code != 200) {
+        if (res != CURLE_OK) {
+            log_error("ONVIF Detection: Request to %s failed: %s", sub->camera_url, curl_easy_strerror(res));
+        } else {
+            log_error("ONVIF request to %s failed with HTTP code %ld", sub->camera_url, http_code);
+        }
+
+        if (op == ONVIF_OP_CREATE) {
+            log_error("Failed to create subscription for %s", sub->camera_url);
+        }
+
+        // A failed pull or renew usually means the camera dropped the subscription
+        sub->active = false;
+        sub->failures++;
+        sub->retry_after = now + RETRY_SECONDS;
+        return;
+    }
+
+    sub->failures = 0;
+
+    switch (op) {
+        case ONVIF_OP_CREATE: {
+            char *subscription_address = extract_subscription_address(sub->response.memory);
+            if (!subscription_address) {
+                log_error("Failed to extract subscription address");
+                sub->failures++;
+                sub->retry_after = now + RETRY_SECONDS;
                 break;
             }
+            strncpy(sub->subscription_address, subscription_address, sizeof(sub->subscription_address) - 1);
+            sub->subscription_address[sizeof(sub->subscription_address) - 1] = '\0';
+            free(subscription_address);
+
+            sub->creation_time = now;
+            sub->expiration_time = now + SUBSCRIPTION_SECONDS;
+            sub->active = true;
+            log_info("Successfully created ONVIF subscription for %s", sub->camera_url);
+            break;
         }
+        case ONVIF_OP_RENEW:
+            sub->expiration_time = now + SUBSCRIPTION_SECONDS;
+            log_info("Renewed ONVIF subscription for %s", sub->camera_url);
+            break;
+        case ONVIF_OP_PULL:
+            if (has_motion_event(sub->response.memory)) {
+                sub->motion_pending = true;
+                log_debug("ONVIF Detection: Motion event from %s", sub->camera_url);
+            }
+            break;
+        case ONVIF_OP_NONE:
+            break;
     }
+}
 
-    log_info("Creating new ONVIF subscription for %s", url);
+/**
+ * Event thread
+ * Keeps one request in flight per camera on a single curl multi handle:
+ * subscribe, then long-poll PullMessages back to back, renewing the
+ * subscription shortly before it terminates.
+ */
+static void *onvif_event_thread_func(void *arg) {
+    (void)arg;
 
-    // Create a new subscription
-    const char *request_body = 
-        "<CreatePullPointSubscription xmlns=\"http://www.onvif.org/ver10/events/wsdl\">\n"
-        "  <InitialTerminationTime>PT1H</InitialTerminationTime>\n"
-        "</CreatePullPointSubscription>";
+    log_info("ONVIF event thread started");
 
-    char *response = send_onvif_request(url, username, password, request_body, "events_service");
-    if (!response) {
-        log_error("Failed to create subscription");
-        pthread_mutex_unlock(&subscription_mutex);
-        return NULL;
-    }
+    while (event_thread_running) {
+        time_t now = time(NULL);
 
-    char *subscription_address = extract_subscription_address(response);
-    free(response);
+        pthread_mutex_lock(&subscription_mutex);
+        for (int i = 0; i < subscription_count; i++) {
+            onvif_subscription_t *sub = &subscriptions[i];
+            if (!sub->in_use || sub->op != ONVIF_OP_NONE) {
+                continue;
+            }
 
-    if (!subscription_address) {
-        log_error("Failed to extract subscription address");
+            // Cameras whose stream stopped using ONVIF detection are dropped
+            if (now - sub->last_used > IDLE_SECONDS) {
+                log_info("Dropping idle ONVIF subscription for %s", sub->camera_url);
+                release_subscription(sub);
+                memset(sub, 0, sizeof(*sub));
+                continue;
+            }
+
+            if (now < sub->retry_after) {
+                continue;
+            }
+
+            if (start_request(sub, now) != 0) {
+                sub->failures++;
+                sub->retry_after = now + RETRY_SECONDS;
+            }
+        }
         pthread_mutex_unlock(&subscription_mutex);
-        return NULL;
-    }
 
-    // Find an empty slot or reuse an inactive one
-    int slot = -1;
-    for (int i = 0; i < subscription_count; i++) {
-        if (!subscriptions[i].active) {
-            slot = i;
-            break;
+        int running_handles = 0;
+        curl_multi_perform(multi_handle, &running_handles);
+
+        CURLMsg *msg;
+        int msgs_left = 0;
+        while ((msg = curl_multi_info_read(multi_handle, &msgs_left))) {
+            if (msg->msg != CURLMSG_DONE) {
+                continue;
+            }
+
+            CURL *easy = msg->easy_handle;
+            CURLcode res = msg->data.result;
+            onvif_subscription_t *sub = NULL;
+            curl_easy_getinfo(easy, CURLINFO_PRIVATE, (char **)&sub);
+            curl_multi_remove_handle(multi_handle, easy);
+
+            if (sub) {
+                pthread_mutex_lock(&subscription_mutex);
+                finish_request(sub, res, time(NULL));
+                pthread_mutex_unlock(&subscription_mutex);
+            }
         }
-    }
 
-    // If no empty slot found, add to the end if there's space
-    if (slot == -1 && subscription_count < MAX_SUBSCRIPTIONS) {
-        slot = subscription_count++;
+        // Sleeps until a camera answers, a new camera is added or a second passes
+        curl_multi_poll(multi_handle, NULL, 0, 1000, NULL);
     }
 
-    // If we found a slot, use it
-    if (slot >= 0) {
-        // Store camera URL, username, and password
-        strncpy(subscriptions[slot].camera_url, url, sizeof(subscriptions[slot].camera_url) - 1);
-        subscriptions[slot].camera_url[sizeof(subscriptions[slot].camera_url) - 1] = '\0';
-        
-        strncpy(subscriptions[slot].username, username, sizeof(subscriptions[slot].username) - 1);
-        subscriptions[slot].username[sizeof(subscriptions[slot].username) - 1] = '\0';
-        
-        strncpy(subscriptions[slot].password, password, sizeof(subscriptions[slot].password) - 1);
-        subscriptions[slot].password[sizeof(subscriptions[slot].password) - 1] = '\0';
-        
-        // Store subscription address
-        strncpy(subscriptions[slot].subscription_address, subscription_address, 
-                sizeof(subscriptions[slot].subscription_address) - 1);
-        subscriptions[slot].subscription_address[sizeof(subscriptions[slot].subscription_address) - 1] = '\0';
-        
-        // Set timestamps
-        time(&subscriptions[slot].creation_time);
-        subscriptions[slot].expiration_time = subscriptions[slot].creation_time + 3600; // 1 hour
-        subscriptions[slot].active = true;
-        
-        log_info("Successfully created ONVIF subscription for %s", url);
-        free(subscription_address);
-        pthread_mutex_unlock(&subscription_mutex);
-        return &subscriptions[slot];
+    // Abandon whatever is still in flight
+    pthread_mutex_lock(&subscription_mutex);
+    for (int i = 0; i < subscription_count; i++) {
+        onvif_subscription_t *sub = &subscriptions[i];
+        if (sub->easy) {
+            curl_multi_remove_handle(multi_handle, sub->easy);
+        }
+        release_subscription(sub);
     }
-
-    log_error("No space for new ONVIF subscription");
-    free(subscription_address);
     pthread_mutex_unlock(&subscription_mutex);
+
+    log_info("ONVIF event thread stopped");
     return NULL;
 }
 
-// Extract service name from subscription address
-static char *extract_service_name(const char *subscription_address) {
-    if (!subscription_address) return NULL;
-
-    // Find the last slash
-    const char *last_slash = strrchr(subscription_address, '/');
-    if (!last_slash) return NULL;
+/**
+ * Find or add the subscription slot for a camera
+ * Must be called with the subscription mutex held.
+ */
+static onvif_subscription_t *get_subscription(const char *url, const char *username, const char *password) {
+    int slot = -1;
+    for (int i = 0; i < subscription_count; i++) {
+        if (subscriptions[i].in_use && strcmp(subscriptions[i].camera_url, url) == 0) {
+            return &subscriptions[i];
+        }
+        if (slot < 0 && !subscriptions[i].in_use) {
+            slot = i;
+        }
+    }
 
-    // Extract the service name
-    char *service = strdup(last_slash + 1);
-    return service;
-}
+    if (slot < 0) {
+        if (subscription_count >= MAX_SUBSCRIPTIONS) {
+            log_error("No space for new ONVIF subscription");
+            return NULL;
+        }
+        slot = subscription_count++;
+    }
 
-// Check for motion events in ONVIF response
-static bool has_motion_event(const char *response) {
-    if (!response) return false;
+    log_info("Creating new ONVIF subscription for %s", url);
 
-    // Check for different motion event patterns
-    if (strstr(response, "RuleEngine/MotionDetector") ||
-        strstr(response, "VideoAnalytics/Motion") ||
-        strstr(response, "MotionAlarm")) {
-        return true;
-    }
+    onvif_subscription_t *sub = &subscriptions[slot];
+    memset(sub, 0, sizeof(*sub));
+    strncpy(sub->camera_url, url, sizeof(sub->camera_url) - 1);
+    strncpy(sub->username, username, sizeof(sub->username) - 1);
+    strncpy(sub->password, password, sizeof(sub->password) - 1);
+    sub->in_use = true;
 
-    return false;
+    // Let the event thread subscribe right away
+    curl_multi_wakeup(multi_handle);
+    return sub;
 }
 
 /**
  * Initialize the ONVIF detection system
  */
 int init_onvif_detection_system(void) {
-    if (initialized && curl_handle) {
+    if (initialized) {
         log_info("ONVIF detection system already initialized");
-        return 0;  // Already initialized and curl handle is valid
-    }
-
-    // If we have a curl handle but initialized is false, clean it up first
-    if (curl_handle) {
-        log_warn("ONVIF detection system has a curl handle but is marked as uninitialized, cleaning up");
-        curl_easy_cleanup(curl_handle);
-        curl_handle = NULL;
+        return 0;
     }
 
     // Initialize curl
@@ -449,9 +615,9 @@ int init_onvif_detection_system(void) {
         return -1;
     }
 
-    curl_handle = curl_easy_init();
-    if (!curl_handle) {
-        log_error("Failed to initialize curl handle");
+    multi_handle = curl_multi_init();
+    if (!multi_handle) {
+        log_error("Failed to initialize curl multi handle");
         curl_global_cleanup();
         return -1;
     }
@@ -460,6 +626,16 @@ int init_onvif_detection_system(void) {
     subscription_count = 0;
     memset(subscriptions, 0, sizeof(subscriptions));
 
+    event_thread_running = true;
+    if (pthread_create(&event_thread, NULL, onvif_event_thread_func, NULL) != 0) {
+        log_error("Failed to create ONVIF event thread");
+        event_thread_running = false;
+        curl_multi_cleanup(multi_handle);
+        multi_handle = NULL;
+        curl_global_cleanup();
+        return -1;
+    }
+
     initialized = true;
     log_info("ONVIF detection system initialized successfully");
     return 0;
@@ -469,21 +645,26 @@ int init_onvif_detection_system(void) {
  * Shutdown the ONVIF detection system
  */
 void shutdown_onvif_detection_system(void) {
-    log_info("Shutting down ONVIF detection system (initialized: %s, curl_handle: %p)",
-             initialized ? "yes" : "no", (void*)curl_handle);
+    log_info("Shutting down ONVIF detection system (initialized: %s)", initialized ? "yes" : "no");
 
-    // Cleanup curl handle if it exists
-    if (curl_handle) {
-        log_info("Cleaning up curl handle");
-        curl_easy_cleanup(curl_handle);
-        curl_handle = NULL;
+    if (!initialized) {
+        return;
     }
 
-    // Only call global cleanup if we were initialized
-    if (initialized) {
-        log_info("Cleaning up curl global resources");
-        curl_global_cleanup();
-    }
+    event_thread_running = false;
+    curl_multi_wakeup(multi_handle);
+    pthread_join(event_thread, NULL);
+
+    curl_multi_cleanup(multi_handle);
+    multi_handle = NULL;
+
+    pthread_mutex_lock(&subscription_mutex);
+    subscription_count = 0;
+    memset(subscriptions, 0, sizeof(subscriptions));
+    pthread_mutex_unlock(&subscription_mutex);
+
+    log_info("Cleaning up curl global resources");
+    curl_global_cleanup();
 
     initialized = false;
     log_info("ONVIF detection system shutdown complete");
@@ -491,6 +672,8 @@ void shutdown_onvif_detection_system(void) {
 
 /**
  * Detect motion using ONVIF events
+ * Events are collected by the event thread; this only reports whether
+ * motion arrived since the previous call, without a request of its own.
  */
 int detect_motion_onvif(const char *onvif_url, const char *username, const char *password,
                        detection_result_t *result, const char *stream_name) {
@@ -500,79 +683,51 @@ int detect_motion_onvif(const char *onvif_url, const char *username, const char
         return -1;
     }
 
-    // Thread safety for curl operations
-    pthread_mutex_lock(&curl_mutex);
-    
     // Initialize result to empty at the beginning to prevent segmentation fault
     if (result) {
         memset(result, 0, sizeof(detection_result_t));
     } else {
         log_error("ONVIF Detection: NULL result pointer provided");
-        pthread_mutex_unlock(&curl_mutex);
         return -1;
     }
-    
-    log_info("ONVIF Detection: Starting detection with URL: %s", onvif_url ? onvif_url : "NULL");
-    log_info("ONVIF Detection: Stream name: %s", stream_name ? stream_name : "NULL");
 
-    if (!initialized || !curl_handle) {
+    if (!initialized) {
         log_error("ONVIF detection system not initialized");
-        pthread_mutex_unlock(&curl_mutex);
         return -1;
     }
 
-    if (!onvif_url || !username || !password || !result) {
+    if (!onvif_url || !username || !password) {
         log_error("Invalid parameters for detect_motion_onvif");
-        pthread_mutex_unlock(&curl_mutex);
         return -1;
     }
 
-    // Get or create subscription
-    pthread_mutex_unlock(&curl_mutex); // Unlock before calling get_subscription which will lock again
+    pthread_mutex_lock(&subscription_mutex);
     onvif_subscription_t *subscription = get_subscription(onvif_url, username, password);
     if (!subscription) {
         log_error("Failed to get subscription for %s", onvif_url);
+        pthread_mutex_unlock(&subscription_mutex);
         return -1;
     }
 
-    // Extract service name from subscription address
-    char *service = extract_service_name(subscription->subscription_address);
-    if (!service) {
-        log_error("Failed to extract service name from subscription address");
-        return -1;
-    }
+    subscription->last_used = time(NULL);
 
-    // Create pull messages request
-    const char *request_body = 
-        "<PullMessages xmlns=\"http://www.onvif.org/ver10/events/wsdl\">\n"
-        "  <Timeout>PT5S</Timeout>\n"
-        "  <MessageLimit>100</MessageLimit>\n"
-        "</PullMessages>";
+    // Credentials may have been changed on the stream since subscribing
+    if (strncmp(subscription->username, username, sizeof(subscription->username) - 1) != 0 ||
+        strncmp(subscription->password, password, sizeof(subscription->password) - 1) != 0) {
+        strncpy(subscription->username, username, sizeof(subscription->username) - 1);
+        strncpy(subscription->password, password, sizeof(subscription->password) - 1);
+    }
 
-    // Send request using the stored credentials from the subscription
-    char *response = send_onvif_request(subscription->camera_url, 
-                                       subscription->username, 
-                                       subscription->password, 
-                                       request_body, 
-                                       service);
-    free(service);
+    bool motion_detected = subscription->motion_pending;
+    subscription->motion_pending = false;
+    bool failing = !subscription->active && subscription->failures > 0;
+    pthread_mutex_unlock(&subscription_mutex);
 
-    if (!response) {
+    if (failing) {
         log_error("Failed to pull messages from subscription");
-        
-        // If pulling messages fails, the subscription might be invalid
-        // Mark it as inactive so we'll create a new one next time
-        pthread_mutex_lock(&subscription_mutex);
-        subscription->active = false;
-        pthread_mutex_unlock(&subscription_mutex);
-        
         return -1;
     }
 
-    // Check for motion events
-    bool motion_detected = has_motion_event(response);
-    free(response);
-
     if (motion_detected) {
         log_info("ONVIF Detection: Motion detected for %s", stream_name);
         
@@ -593,7 +748,7 @@ int detect_motion_onvif(const char *onvif_url, const char *username, const char
             log_warn("No stream name provided, skipping database storage");
         }
     } else {
-        log_info("ONVIF Detection: No motion detected for %s", stream_name);
+        log_debug("ONVIF Detection: No motion detected for %s", stream_name);
         result->count = 0;
     }
 
@@ -2,13 +2,17 @@
 #include "video/stream_manager.h"
 #include "core/logger.h"
 #include "database/db_streams.h"
+#include "database/db_onvif_cache.h"
 #include "video/stream_protocol.h"
+#include "video/ffmpeg_utils.h"
+#include "video/onvif_xml.h"
+#include "video/dns_cache.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <pthread.h>
 #include <curl/curl.h>
-#include "ezxml.h"
 #include <mbedtls/sha1.h>
 #include <mbedtls/base64.h>
 #include <libavformat/avformat.h>
@@ -115,6 +119,7 @@ static char* send_soap_request(const char *device_url, const char *soap_action,
     CURLcode res;
     MemoryStruct chunk;
     struct curl_slist *headers = NULL;
+    struct curl_slist *resolve = NULL;
     char *soap_envelope = NULL;
     char *response = NULL;
     char nonce[64] = {0};
@@ -167,8 +172,15 @@ static char* send_soap_request(const char *device_url, const char *soap_action,
         headers = curl_slist_append(headers, soap_action_header);
     }
     
+    // Use the cached address of the camera instead of resolving it again
+    char resolve_entry[320];
+    if (dns_cache_curl_entry(device_url, resolve_entry, sizeof(resolve_entry)) == 0) {
+        resolve = curl_slist_append(resolve, resolve_entry);
+    }
+
     // Set up CURL options with more verbose debugging
     curl_easy_setopt(curl, CURLOPT_URL, device_url);
+    curl_easy_setopt(curl, CURLOPT_RESOLVE, resolve);
     curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
     curl_easy_setopt(curl, CURLOPT_POSTFIELDS, soap_envelope);
     curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
@@ -230,6 +242,7 @@ static char* send_soap_request(const char *device_url, const char *soap_action,
     // Clean up
     curl_easy_cleanup(curl);
     curl_slist_free_all(headers);
+    curl_slist_free_all(resolve);
     free(soap_envelope);
     free(security_header);
     free(chunk.memory);
@@ -237,40 +250,6 @@ static char* send_soap_request(const char *device_url, const char *soap_action,
     return response;
 }
 
-// Find a child element by name
-static ezxml_t find_child(ezxml_t parent, const char *name) {
-    if (!parent) return NULL;
-    return ezxml_child(parent, name);
-}
-
-// Find a child element by name with namespace prefix
-static ezxml_t find_child_with_ns(ezxml_t parent, const char *ns, const char *name) {
-    if (!parent) return NULL;
-    
-    char full_name[256];
-    snprintf(full_name, sizeof(full_name), "%s:%s", ns, name);
-    
-    return ezxml_child(parent, full_name);
-}
-
-// Find all elements with a specific name
-static void find_elements_by_name(ezxml_t root, const char *name, ezxml_t *results, int *count, int max_count) {
-    if (!root || !name || !results || !count || max_count <= 0) return;
-    
-    // Check if the current element matches
-    if (strcmp(root->name, name) == 0) {
-        if (*count < max_count) {
-            results[*count] = root;
-            (*count)++;
-        }
-    }
-    
-    // Check children
-    for (ezxml_t child = root->child; child; child = child->sibling) {
-        find_elements_by_name(child, name, results, count, max_count);
-    }
-}
-
 // Get media service URL from device service
 static char* get_media_service_url(const char *device_url, const char *username, const char *password) {
     char *request_body = 
@@ -284,71 +263,26 @@ static char* get_media_service_url(const char *device_url, const char *username,
         return NULL;
     }
     
-    // Parse the XML response
-    ezxml_t xml = ezxml_parse_str(response, strlen(response));
-    if (!xml) {
-        log_error("Failed to parse XML response");
-        free(response);
-        return NULL;
-    }
-    
-    // Find the media service URL
+    // Find the media service among the services
     char *media_url = NULL;
-    
-    // Try with SOAP-ENV namespace first
-    ezxml_t body = find_child(xml, "SOAP-ENV:Body");
-    if (!body) {
-        // Try with s namespace (used by onvif_simple_server)
-        body = find_child(xml, "s:Body");
-        log_info("Using 's:Body' namespace for XML parsing");
-    }
-    
-    if (body) {
-        // Try with tds namespace
-        ezxml_t get_services_response = find_child(body, "tds:GetServicesResponse");
-        if (!get_services_response) {
-            // Try without namespace prefix
-            get_services_response = find_child(body, "GetServicesResponse");
-            log_info("Using 'GetServicesResponse' without namespace for XML parsing");
-        }
-        
-        if (get_services_response) {
-            // Try with tds namespace
-            ezxml_t service = find_child(get_services_response, "tds:Service");
-            if (!service) {
-                // Try without namespace prefix
-                service = find_child(get_services_response, "Service");
-                log_info("Using 'Service' without namespace for XML parsing");
-            }
-            
-            while (service) {
-                // Try with and without namespace for Namespace element
-                ezxml_t namespace = find_child(service, "Namespace");
-                if (!namespace) {
-                    namespace = find_child(service, "tds:Namespace");
-                }
-                
-                if (namespace && strcmp(ezxml_txt(namespace), "http://www.onvif.org/ver10/media/wsdl") == 0) {
-                    // Try with and without namespace for XAddr element
-                    ezxml_t xaddr = find_child(service, "XAddr");
-                    if (!xaddr) {
-                        xaddr = find_child(service, "tds:XAddr");
-                    }
-                    
-                    if (xaddr) {
-                        media_url = strdup(ezxml_txt(xaddr));
-                        log_info("Found media service URL: %s", media_url);
-                        break;
-                    }
-                }
-                
-                // Try next sibling
-                service = service->next;
-                if (!service) {
-                    // Try next sibling with different method
-                    service = ezxml_next(get_services_response->child);
-                }
-            }
+    char namespace[128] = {0};
+    char xaddr[MAX_URL_LENGTH] = {0};
+    onvif_xml_reader_t reader;
+    onvif_xml_event_t event;
+    
+    onvif_xml_init(&reader, response, strlen(response));
+    while (!media_url && (event = onvif_xml_next(&reader)) != ONVIF_XML_EOF && event != ONVIF_XML_ERROR) {
+        if (event == ONVIF_XML_START && onvif_xml_name_is(&reader, "Service")) {
+            namespace[0] = '\0';
+            xaddr[0] = '\0';
+        } else if (event == ONVIF_XML_TEXT && onvif_xml_path_is(&reader, "Service/Namespace")) {
+            onvif_xml_copy_text(&reader, namespace, sizeof(namespace));
+        } else if (event == ONVIF_XML_TEXT && onvif_xml_path_is(&reader, "Service/XAddr")) {
+            onvif_xml_copy_text(&reader, xaddr, sizeof(xaddr));
+        } else if (event == ONVIF_XML_END && onvif_xml_name_is(&reader, "Service") &&
+                   strcmp(namespace, "http://www.onvif.org/ver10/media/wsdl") == 0 && xaddr[0]) {
+            media_url = strdup(xaddr);
+            log_info("Found media service URL: %s", media_url);
         }
     }
     
@@ -379,148 +313,33 @@ static char* get_media_service_url(const char *device_url, const char *username,
         }
     }
     
-    // Clean up
-    ezxml_free(xml);
     free(response);
     
     return media_url;
 }
 
-// Get ONVIF device profiles
-int get_onvif_device_profiles(const char *device_url, const char *username, 
-                             const char *password, onvif_profile_t *profiles, 
-                             int max_profiles) {
-    char *media_url = get_media_service_url(device_url, username, password);
-    if (!media_url) {
-        log_error("Couldn't get media service URL");
-        return 0;
-    }
-    
-    log_info("Getting profiles for ONVIF device: %s (Media URL: %s)", device_url, media_url);
-    
-    char *request_body = "<GetProfiles xmlns=\"http://www.onvif.org/ver10/media/wsdl\"/>";
-    char *response = send_soap_request(media_url, NULL, request_body, username, password);
+// Get the firmware version of a device, empty if the device does not tell
+static void get_firmware_version(const char *device_url, const char *username, const char *password,
+                                 char *version, size_t size) {
+    version[0] = '\0';
+
+    char *request_body = "<GetDeviceInformation xmlns=\"http://www.onvif.org/ver10/device/wsdl\"/>";
+    char *response = send_soap_request(device_url, NULL, request_body, username, password);
     if (!response) {
-        log_error("Failed to get profiles");
-        free(media_url);
-        return 0;
-    }
-    
-    // Parse the XML response
-    ezxml_t xml = ezxml_parse_str(response, strlen(response));
-    if (!xml) {
-        log_error("Failed to parse XML response");
-        free(response);
-        free(media_url);
-        return 0;
-    }
-    
-    // Find all profiles
-    ezxml_t profile_elements[max_profiles];
-    int profile_count = 0;
-    
-    ezxml_t body = find_child(xml, "SOAP-ENV:Body");
-    if (body) {
-        ezxml_t get_profiles_response = find_child(body, "trt:GetProfilesResponse");
-        if (get_profiles_response) {
-            ezxml_t profile = find_child(get_profiles_response, "trt:Profiles");
-            while (profile && profile_count < max_profiles) {
-                profile_elements[profile_count++] = profile;
-                profile = profile->next;
-            }
-        }
+        log_warn("Failed to get device information");
+        return;
     }
-    
-    if (profile_count == 0) {
-        log_error("No profiles found");
-        ezxml_free(xml);
-        free(response);
-        free(media_url);
-        return 0;
-    }
-    
-    log_info("Found %d profiles, returning up to %d", profile_count, max_profiles);
-    
-    int count = (profile_count < max_profiles) ? profile_count : max_profiles;
-    
-    for (int i = 0; i < count; i++) {
-        ezxml_t profile = profile_elements[i];
-        
-        // Get profile token
-        const char *token = ezxml_attr(profile, "token");
-        if (token) {
-            strncpy(profiles[i].token, token, sizeof(profiles[i].token) - 1);
-            profiles[i].token[sizeof(profiles[i].token) - 1] = '\0';
-        }
-        
-        // Get profile name
-        ezxml_t name = find_child(profile, "tt:Name");
-        if (name) {
-            strncpy(profiles[i].name, ezxml_txt(name), sizeof(profiles[i].name) - 1);
-            profiles[i].name[sizeof(profiles[i].name) - 1] = '\0';
-        }
-        
-        // Get video encoder configuration
-        ezxml_t video_encoder = find_child(profile, "tt:VideoEncoderConfiguration");
-        if (video_encoder) {
-            ezxml_t encoding = find_child(video_encoder, "tt:Encoding");
-            if (encoding) {
-                strncpy(profiles[i].encoding, ezxml_txt(encoding), sizeof(profiles[i].encoding) - 1);
-                profiles[i].encoding[sizeof(profiles[i].encoding) - 1] = '\0';
-            }
-            
-            ezxml_t resolution = find_child(video_encoder, "tt:Resolution");
-            if (resolution) {
-                ezxml_t width = find_child(resolution, "tt:Width");
-                if (width) {
-                    profiles[i].width = atoi(ezxml_txt(width));
-                }
-                
-                ezxml_t height = find_child(resolution, "tt:Height");
-                if (height) {
-                    profiles[i].height = atoi(ezxml_txt(height));
-                }
-            }
-            
-            ezxml_t rate_control = find_child(video_encoder, "tt:RateControl");
-            if (rate_control) {
-                ezxml_t fps = find_child(rate_control, "tt:FrameRateLimit");
-                if (fps) {
-                    profiles[i].fps = atoi(ezxml_txt(fps));
-                }
-                
-                ezxml_t bitrate = find_child(rate_control, "tt:BitrateLimit");
-                if (bitrate) {
-                    profiles[i].bitrate = atoi(ezxml_txt(bitrate));
-                }
-            }
-        }
-        
-        // Get the stream URI for this profile
-        get_onvif_stream_url(device_url, username, password, profiles[i].token, 
-                            profiles[i].stream_uri, sizeof(profiles[i].stream_uri));
+
+    if (!onvif_xml_find_text(response, strlen(response), "GetDeviceInformationResponse/FirmwareVersion",
+                             version, size)) {
+        version[0] = '\0';
     }
-    
-    // Clean up
-    ezxml_free(xml);
     free(response);
-    free(media_url);
-    
-    return count;
 }
 
-// Get ONVIF stream URL for a specific profile
-int get_onvif_stream_url(const char *device_url, const char *username, 
-                        const char *password, const char *profile_token, 
-                        char *stream_url, size_t url_size) {
-    char *media_url = get_media_service_url(device_url, username, password);
-    if (!media_url) {
-        log_error("Couldn't get media service URL");
-        return -1;
-    }
-    
-    log_info("Getting stream URL for ONVIF device: %s, profile: %s", device_url, profile_token);
-    
+// Get the stream URI of a profile as the device reports it
+static int query_stream_uri(const char *media_url, const char *username, const char *password,
+                            const char *profile_token, char *uri_out, size_t uri_size) {
     // Create request body for GetStreamUri
     char request_body[512];
     snprintf(request_body, sizeof(request_body),
@@ -538,45 +357,29 @@ int get_onvif_stream_url(const char *device_url, const char *username,
     char *response = send_soap_request(media_url, NULL, request_body, username, password);
     if (!response) {
         log_error("Failed to get stream URI");
-        free(media_url);
-        return -1;
-    }
-    
-    // Parse the XML response
-    ezxml_t xml = ezxml_parse_str(response, strlen(response));
-    if (!xml) {
-        log_error("Failed to parse XML response");
-        free(response);
-        free(media_url);
         return -1;
     }
     
     // Extract the URI
-    const char *uri = NULL;
-    ezxml_t body = find_child(xml, "SOAP-ENV:Body");
-    if (body) {
-        ezxml_t get_stream_uri_response = find_child(body, "trt:GetStreamUriResponse");
-        if (get_stream_uri_response) {
-            ezxml_t media_uri = find_child(get_stream_uri_response, "trt:MediaUri");
-            if (media_uri) {
-                ezxml_t uri_element = find_child(media_uri, "tt:Uri");
-                if (uri_element) {
-                    uri = ezxml_txt(uri_element);
-                }
-            }
-        }
-    }
-    
-    if (!uri) {
+    char uri[MAX_URL_LENGTH];
+    if (!onvif_xml_find_text(response, strlen(response), "MediaUri/Uri", uri, sizeof(uri)) || !uri[0]) {
         log_error("Stream URI not found in response");
-        ezxml_free(xml);
         free(response);
-        free(media_url);
         return -1;
     }
     
     log_info("Got stream URI: %s", uri);
+    strncpy(uri_out, uri, uri_size - 1);
+    uri_out[uri_size - 1] = '\0';
+    
+    free(response);
     
+    return 0;
+}
+
+// Build the stream URL with the credentials embedded in the URI
+static void embed_stream_credentials(const char *uri, const char *username, const char *password,
+                                     char *stream_url, size_t url_size) {
     // Copy the URI to the output parameter
     strncpy(stream_url, uri, url_size - 1);
     stream_url[url_size - 1] = '\0';
@@ -637,11 +440,284 @@ int get_onvif_stream_url(const char *device_url, const char *username,
     } else {
         log_info("No credentials provided, using original stream URI: %s", uri);
     }
+}
+
+/**
+ * Query the capabilities of a device and cache them
+ * Profiles carry the stream URIs as the device reports them.
+ *
+ * @return Number of profiles, 0 if none could be read
+ */
+static int fetch_device_capabilities(const char *device_url, const char *username, const char *password,
+                                     onvif_cache_info_t *info, onvif_profile_t *profiles, int max_profiles) {
+    memset(info, 0, sizeof(*info));
+
+    get_firmware_version(device_url, username, password, info->firmware_version, sizeof(info->firmware_version));
+
+    char *media_url = get_media_service_url(device_url, username, password);
+    if (!media_url) {
+        log_error("Couldn't get media service URL");
+        return 0;
+    }
+    strncpy(info->media_url, media_url, sizeof(info->media_url) - 1);
     
-    // Clean up
-    ezxml_free(xml);
+    log_info("Getting profiles for ONVIF device: %s (Media URL: %s)", device_url, media_url);
+    
+    char *request_body = "<GetProfiles xmlns=\"http://www.onvif.org/ver10/media/wsdl\"/>";
+    char *response = send_soap_request(media_url, NULL, request_body, username, password);
+    if (!response) {
+        log_error("Failed to get profiles");
+        free(media_url);
+        return 0;
+    }
+    
+    // Read the profiles in one pass over the response
+    int count = 0;
+    onvif_profile_t *profile = NULL;
+    char value[32];
+    onvif_xml_reader_t reader;
+    onvif_xml_event_t event;
+    
+    onvif_xml_init(&reader, response, strlen(response));
+    while ((event = onvif_xml_next(&reader)) != ONVIF_XML_EOF && event != ONVIF_XML_ERROR) {
+        if (event == ONVIF_XML_START && onvif_xml_path_is(&reader, "GetProfilesResponse/Profiles")) {
+            if (count == max_profiles) {
+                break;
+            }
+            profile = &profiles[count++];
+            memset(profile, 0, sizeof(*profile));
+            onvif_xml_copy_attr(&reader, "token", profile->token, sizeof(profile->token));
+        } else if (event == ONVIF_XML_END && onvif_xml_path_is(&reader, "GetProfilesResponse/Profiles")) {
+            profile = NULL;
+        } else if (event == ONVIF_XML_TEXT && profile) {
+            if (onvif_xml_path_is(&reader, "Profiles/Name")) {
+                onvif_xml_copy_text(&reader, profile->name, sizeof(profile->name));
+            } else if (onvif_xml_path_is(&reader, "Profiles/VideoEncoderConfiguration/Encoding")) {
+                onvif_xml_copy_text(&reader, profile->encoding, sizeof(profile->encoding));
+            } else if (onvif_xml_path_is(&reader, "VideoEncoderConfiguration/Resolution/Width")) {
+                onvif_xml_copy_text(&reader, value, sizeof(value));
+                profile->width = atoi(value);
+            } else if (onvif_xml_path_is(&reader, "VideoEncoderConfiguration/Resolution/Height")) {
+                onvif_xml_copy_text(&reader, value, sizeof(value));
+                profile->height = atoi(value);
+            } else if (onvif_xml_path_is(&reader, "VideoEncoderConfiguration/RateControl/FrameRateLimit")) {
+                onvif_xml_copy_text(&reader, value, sizeof(value));
+                profile->fps = atoi(value);
+            } else if (onvif_xml_path_is(&reader, "VideoEncoderConfiguration/RateControl/BitrateLimit")) {
+                onvif_xml_copy_text(&reader, value, sizeof(value));
+                profile->bitrate = atoi(value);
+            }
+        }
+    }
     free(response);
+    
+    if (count == 0) {
+        log_error("No profiles found");
+        free(media_url);
+        return 0;
+    }
+    
+    log_info("Found %d profiles", count);
+    
+    for (int i = 0; i < count; i++) {
+        // Get the stream URI for this profile, reusing the media service URL
+        query_stream_uri(media_url, username, password, profiles[i].token,
+                         profiles[i].stream_uri, sizeof(profiles[i].stream_uri));
+    }
+    
     free(media_url);
+
+    info->updated_at = time(NULL);
+    store_onvif_cache(device_url, info, profiles, count);
+    
+    return count;
+}
+
+// Background refresh of a stale cache entry
+typedef struct {
+    char device_url[MAX_URL_LENGTH];
+    char username[64];
+    char password[64];
+    char firmware_version[64];
+} cache_refresh_t;
+
+// Devices being refreshed, so each has at most one refresh running
+static char g_refreshing[MAX_ONVIF_CACHE_REFRESHES][MAX_URL_LENGTH];
+static pthread_mutex_t g_refresh_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void *cache_refresh_thread(void *arg) {
+    cache_refresh_t *job = (cache_refresh_t *)arg;
+    char firmware_version[64];
+
+    // Same firmware means same capabilities, which costs one round trip to tell
+    get_firmware_version(job->device_url, job->username, job->password,
+                         firmware_version, sizeof(firmware_version));
+    if (firmware_version[0] && strcmp(firmware_version, job->firmware_version) == 0) {
+        log_info("ONVIF device %s still runs firmware %s, keeping cached capabilities",
+                 job->device_url, firmware_version);
+        touch_onvif_cache(job->device_url, time(NULL));
+    } else {
+        onvif_cache_info_t info;
+        onvif_profile_t *profiles = calloc(MAX_ONVIF_CACHED_PROFILES, sizeof(onvif_profile_t));
+        if (profiles) {
+            log_info("Refreshing cached capabilities of ONVIF device %s", job->device_url);
+            fetch_device_capabilities(job->device_url, job->username, job->password,
+                                      &info, profiles, MAX_ONVIF_CACHED_PROFILES);
+            free(profiles);
+        }
+    }
+
+    pthread_mutex_lock(&g_refresh_mutex);
+    for (int i = 0; i < MAX_ONVIF_CACHE_REFRESHES; i++) {
+        if (strcmp(g_refreshing[i], job->device_url) == 0) {
+            g_refreshing[i][0] = '\0';
+            break;
+        }
+    }
+    pthread_mutex_unlock(&g_refresh_mutex);
+
+    free(job);
+    return NULL;
+}
+
+// Start a background refresh of a device, unless one is running already
+static void schedule_cache_refresh(const char *device_url, const char *username, const char *password,
+                                   const onvif_cache_info_t *info) {
+    pthread_mutex_lock(&g_refresh_mutex);
+    int free_slot = -1;
+    for (int i = 0; i < MAX_ONVIF_CACHE_REFRESHES; i++) {
+        if (strcmp(g_refreshing[i], device_url) == 0) {
+            pthread_mutex_unlock(&g_refresh_mutex);
+            return;
+        }
+        if (free_slot < 0 && g_refreshing[i][0] == '\0') {
+            free_slot = i;
+        }
+    }
+    if (free_slot < 0) {
+        // Try again on the next lookup
+        pthread_mutex_unlock(&g_refresh_mutex);
+        return;
+    }
+
+    cache_refresh_t *job = calloc(1, sizeof(cache_refresh_t));
+    if (!job) {
+        pthread_mutex_unlock(&g_refresh_mutex);
+        return;
+    }
+    strncpy(job->device_url, device_url, sizeof(job->device_url) - 1);
+    if (username) {
+        strncpy(job->username, username, sizeof(job->username) - 1);
+    }
+    if (password) {
+        strncpy(job->password, password, sizeof(job->password) - 1);
+    }
+    strncpy(job->firmware_version, info->firmware_version, sizeof(job->firmware_version) - 1);
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, cache_refresh_thread, job) != 0) {
+        log_error("Failed to start ONVIF cache refresh for %s", device_url);
+        pthread_mutex_unlock(&g_refresh_mutex);
+        free(job);
+        return;
+    }
+    pthread_detach(thread);
+    strncpy(g_refreshing[free_slot], job->device_url, MAX_URL_LENGTH - 1);
+    pthread_mutex_unlock(&g_refresh_mutex);
+}
+
+/**
+ * Get the capabilities of a device, from the cache if it has them
+ * A stale cache entry is still used and refreshed in the background.
+ *
+ * @return Number of profiles, 0 if none could be read
+ */
+static int get_device_capabilities(const char *device_url, const char *username, const char *password,
+                                   onvif_cache_info_t *info, onvif_profile_t *profiles) {
+    int count = get_onvif_cache(device_url, info, profiles, MAX_ONVIF_CACHED_PROFILES);
+    if (count > 0) {
+        log_info("Using cached capabilities of ONVIF device %s (%d profiles)", device_url, count);
+        if (time(NULL) - info->updated_at > ONVIF_CACHE_TTL) {
+            schedule_cache_refresh(device_url, username, password, info);
+        }
+        return count;
+    }
+
+    return fetch_device_capabilities(device_url, username, password, info, profiles, MAX_ONVIF_CACHED_PROFILES);
+}
+
+// Get ONVIF device profiles
+int get_onvif_device_profiles(const char *device_url, const char *username, 
+                             const char *password, onvif_profile_t *profiles, 
+                             int max_profiles) {
+    onvif_cache_info_t info;
+
+    if (!device_url || !profiles || max_profiles <= 0) {
+        return 0;
+    }
+
+    // Always read every profile, so the cache holds all of them
+    onvif_profile_t *all_profiles = calloc(MAX_ONVIF_CACHED_PROFILES, sizeof(onvif_profile_t));
+    if (!all_profiles) {
+        log_error("Failed to allocate memory for ONVIF profiles");
+        return 0;
+    }
+
+    int count = get_device_capabilities(device_url, username, password, &info, all_profiles);
+    if (count > max_profiles) {
+        count = max_profiles;
+    }
+    
+    for (int i = 0; i < count; i++) {
+        profiles[i] = all_profiles[i];
+        embed_stream_credentials(all_profiles[i].stream_uri, username, password,
+                                 profiles[i].stream_uri, sizeof(profiles[i].stream_uri));
+    }
+    free(all_profiles);
+    
+    return count;
+}
+
+// Get ONVIF stream URL for a specific profile
+int get_onvif_stream_url(const char *device_url, const char *username, 
+                        const char *password, const char *profile_token, 
+                        char *stream_url, size_t url_size) {
+    onvif_cache_info_t info;
+    char uri[MAX_URL_LENGTH] = {0};
+
+    log_info("Getting stream URL for ONVIF device: %s, profile: %s", device_url, profile_token);
+
+    onvif_profile_t *profiles = calloc(MAX_ONVIF_CACHED_PROFILES, sizeof(onvif_profile_t));
+    if (!profiles) {
+        log_error("Failed to allocate memory for ONVIF profiles");
+        return -1;
+    }
+
+    int count = get_device_capabilities(device_url, username, password, &info, profiles);
+    for (int i = 0; i < count; i++) {
+        if (strcmp(profiles[i].token, profile_token) == 0 && profiles[i].stream_uri[0]) {
+            strncpy(uri, profiles[i].stream_uri, sizeof(uri) - 1);
+            break;
+        }
+    }
+    free(profiles);
+
+    // Profiles beyond the cached ones, or without a URI, are asked for directly
+    if (!uri[0]) {
+        char *media_url = count > 0 && info.media_url[0] ? strdup(info.media_url)
+                                                         : get_media_service_url(device_url, username, password);
+        if (!media_url) {
+            log_error("Couldn't get media service URL");
+            return -1;
+        }
+        int rc = query_stream_uri(media_url, username, password, profile_token, uri, sizeof(uri));
+        free(media_url);
+        if (rc != 0) {
+            return -1;
+        }
+    }
+
+    embed_stream_credentials(uri, username, password, stream_url, url_size);
     
     return 0;
 }
@@ -841,13 +917,15 @@ int test_onvif_connection(const char *url, const char *username, const char *pas
                 
                 if (ret < 0) {
                     log_error("All connection attempts failed for stream: %s", profiles[0].stream_uri);
+                    // The cached URI may be outdated, ask the device again next time
+                    delete_onvif_cache(url);
                     return -1;
                 }
             }
         }
         
         // Close the stream
-        avformat_close_input(&input_ctx);
+        safe_avformat_cleanup(&input_ctx);
         log_info("Successfully connected to stream: %s", profiles[0].stream_uri);
     }
     
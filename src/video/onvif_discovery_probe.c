@@ -177,3 +177,25 @@ int send_all_discovery_probes(int sock, const char *ip_addr, struct sockaddr_in
     
     return 0;
 }
+
+// Send discovery probes to an address using all message templates, back to back
+int send_discovery_probe_burst(int sock, const struct sockaddr_in *dest_addr) {
+    const char *templates[] = {
+        ONVIF_DISCOVERY_MSG,
+        ONVIF_DISCOVERY_MSG_ALT,
+        ONVIF_DISCOVERY_MSG_WITH_SCOPE
+    };
+    char uuid[64];
+    char message[1024];
+    int sent = 0;
+    
+    for (size_t i = 0; i < sizeof(templates) / sizeof(templates[0]); i++) {
+        generate_uuid(uuid, sizeof(uuid));
+        int message_len = snprintf(message, sizeof(message), templates[i], uuid);
+        if (sendto(sock, message, message_len, 0, (const struct sockaddr *)dest_addr, sizeof(*dest_addr)) == message_len) {
+            sent++;
+        }
+    }
+    
+    return sent;
+}
@@ -1,4 +1,5 @@
 #include "video/onvif_discovery_response.h"
+#include "video/onvif_xml.h"
 #include "core/logger.h"
 #include <stdio.h>
 #include <stdlib.h>
@@ -10,51 +11,12 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <errno.h>
-#include <ctype.h>
 #include <time.h>
 #include <stdbool.h>
 #include <netinet/ip.h>
 
-// Helper function to extract content between XML tags
-static char* extract_xml_content(const char *xml, const char *tag_start, const char *tag_end, char *buffer, size_t buffer_size) {
-    const char *start = strstr(xml, tag_start);
-    if (!start) {
-        return NULL;
-    }
-    
-    start += strlen(tag_start);
-    const char *end = strstr(start, tag_end);
-    if (!end) {
-        return NULL;
-    }
-    
-    size_t len = end - start;
-    if (len >= buffer_size) {
-        len = buffer_size - 1;
-    }
-    
-    strncpy(buffer, start, len);
-    buffer[len] = '\0';
-    
-    // Trim leading/trailing whitespace
-    char *trim_start = buffer;
-    char *trim_end = buffer + len - 1;
-    
-    while (*trim_start && isspace(*trim_start)) trim_start++;
-    while (trim_end > trim_start && isspace(*trim_end)) *trim_end-- = '\0';
-    
-    if (trim_start != buffer) {
-        memmove(buffer, trim_start, strlen(trim_start) + 1);
-    }
-    
-    return buffer;
-}
-
 // Parse ONVIF device information from discovery response
 int parse_device_info(const char *response, onvif_device_info_t *device_info) {
-    // This is a more robust implementation for parsing ONVIF discovery responses
-    // without using a full XML parser
-    
     // Initialize device info
     memset(device_info, 0, sizeof(onvif_device_info_t));
     
@@ -62,58 +24,37 @@ int parse_device_info(const char *response, onvif_device_info_t *device_info) {
     char debug_buffer[501];
     strncpy(debug_buffer, response, 500);
     debug_buffer[500] = '\0';
-    log_info("Parsing response: %s...", debug_buffer);
+    log_debug("Parsing response: %s...", debug_buffer);
     
-    // Check if this is a valid ONVIF response and not a probe message
-    if (strstr(response, "Probe") && !strstr(response, "ProbeMatch")) {
-        log_info("Ignoring probe message (not a device response)");
-        return -1;
+    // Collect XAddrs and Types of a ProbeMatch or Hello in one pass
+    char xaddrs[MAX_URL_LENGTH] = {0};
+    char types[128] = {0};
+    bool is_probe = false;
+    onvif_xml_reader_t reader;
+    onvif_xml_event_t event;
+    
+    onvif_xml_init(&reader, response, strlen(response));
+    while ((event = onvif_xml_next(&reader)) != ONVIF_XML_EOF && event != ONVIF_XML_ERROR) {
+        if (event == ONVIF_XML_START && onvif_xml_path_is(&reader, "Body/Probe")) {
+            is_probe = true;
+            break;
+        }
+        if (event != ONVIF_XML_TEXT) {
+            continue;
+        }
+        if (onvif_xml_path_is(&reader, "ProbeMatch/XAddrs") || onvif_xml_path_is(&reader, "Hello/XAddrs")) {
+            onvif_xml_copy_text(&reader, xaddrs, sizeof(xaddrs));
+        } else if (onvif_xml_path_is(&reader, "ProbeMatch/Types") || onvif_xml_path_is(&reader, "Hello/Types")) {
+            onvif_xml_copy_text(&reader, types, sizeof(types));
+        }
     }
     
-    if (!strstr(response, "NetworkVideoTransmitter") && 
-        !strstr(response, "Device") && 
-        !strstr(response, "ONVIF")) {
-        log_info("Not an ONVIF response (missing required keywords)");
+    // Our own probes come back on multicast
+    if (is_probe) {
+        log_info("Ignoring probe message (not a device response)");
         return -1;
     }
     
-    // Try to extract XAddrs using different tag formats
-    char xaddrs[MAX_URL_LENGTH] = {0};
-    
-    // Try with d:XAddrs format
-    if (!extract_xml_content(response, "<d:XAddrs>", "</d:XAddrs>", xaddrs, sizeof(xaddrs))) {
-        // Try with XAddrs format
-        if (!extract_xml_content(response, "<XAddrs>", "</XAddrs>", xaddrs, sizeof(xaddrs))) {
-            // Try with any namespace prefix
-            const char *xaddr_tag = strstr(response, "XAddrs>");
-            if (xaddr_tag) {
-                const char *start = strchr(xaddr_tag, '>');
-                if (start) {
-                    start++; // Skip '>'
-                    const char *end = strstr(start, "</");
-                    if (end) {
-                        size_t len = end - start;
-                        if (len < sizeof(xaddrs)) {
-                            strncpy(xaddrs, start, len);
-                            xaddrs[len] = '\0';
-                            
-                            // Trim whitespace
-                            char *trim_start = xaddrs;
-                            char *trim_end = xaddrs + len - 1;
-                            
-                            while (*trim_start && isspace(*trim_start)) trim_start++;
-                            while (trim_end > trim_start && isspace(*trim_end)) *trim_end-- = '\0';
-                            
-                            if (trim_start != xaddrs) {
-                                memmove(xaddrs, trim_start, strlen(trim_start) + 1);
-                            }
-                        }
-                    }
-                }
-            }
-        }
-    }
-    
     if (strlen(xaddrs) == 0) {
         log_debug("Failed to find XAddrs in response");
         return -1;
@@ -158,17 +99,8 @@ int parse_device_info(const char *response, onvif_device_info_t *device_info) {
         }
     }
     
-    // Try to extract device type/model information
-    char types[128] = {0};
-    
-    // Try with d:Types format
-    if (!extract_xml_content(response, "<d:Types>", "</d:Types>", types, sizeof(types))) {
-        // Try with Types format
-        extract_xml_content(response, "<Types>", "</Types>", types, sizeof(types));
-    }
-    
+    // Extract model information if available
     if (strlen(types) > 0) {
-        // Extract model information if available
         if (strstr(types, "NetworkVideoTransmitter")) {
             strncpy(device_info->model, "NetworkVideoTransmitter", sizeof(device_info->model) - 1);
             device_info->model[sizeof(device_info->model) - 1] = '\0';
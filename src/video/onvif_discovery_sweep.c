@@ -0,0 +1,328 @@
+#define _GNU_SOURCE
+
+#include "video/onvif_discovery_sweep.h"
+#include "video/onvif_discovery_probe.h"
+#include "video/onvif_discovery_response.h"
+#include "core/logger.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+// Ports checked on every address
+static const uint16_t sweep_ports[] = {3702, 80};
+#define SWEEP_PORT_COUNT (sizeof(sweep_ports) / sizeof(sweep_ports[0]))
+
+// Marks the UDP socket in epoll events; connects use their slot index
+#define SWEEP_UDP_TAG ONVIF_SWEEP_MAX_IN_FLIGHT
+
+#define SWEEP_RECV_BUFFER_SIZE 16384
+
+// Port check in flight
+typedef struct {
+    int fd;                     // -1 if the slot is free
+    uint32_t ip;
+    int64_t deadline_ms;
+} sweep_connect_t;
+
+// State of one sweep
+typedef struct {
+    int epfd;
+    int udp;
+    char (*candidates)[16];
+    int max_candidates;
+    int candidate_count;
+    onvif_device_info_t *devices;
+    int max_devices;
+    int device_count;
+    int64_t last_probe_ms;
+} sweep_t;
+
+static int64_t sweep_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void send_probes(sweep_t *sweep, uint32_t ip) {
+    struct sockaddr_in dest_addr;
+    memset(&dest_addr, 0, sizeof(dest_addr));
+    dest_addr.sin_family = AF_INET;
+    dest_addr.sin_port = htons(3702);  // WS-Discovery port
+    dest_addr.sin_addr.s_addr = htonl(ip);
+
+    if (send_discovery_probe_burst(sweep->udp, &dest_addr) == 0) {
+        log_debug("Failed to send discovery probes to %s: %s", inet_ntoa(dest_addr.sin_addr), strerror(errno));
+    }
+    sweep->last_probe_ms = sweep_now_ms();
+}
+
+/**
+ * Record a host with an open port and probe it, once per host
+ */
+static void host_found(sweep_t *sweep, uint32_t ip) {
+    char ip_addr[16];
+    struct in_addr addr = { .s_addr = htonl(ip) };
+    inet_ntop(AF_INET, &addr, ip_addr, sizeof(ip_addr));
+
+    for (int i = 0; i < sweep->candidate_count; i++) {
+        if (strcmp(sweep->candidates[i], ip_addr) == 0) {
+            return;
+        }
+    }
+    if (sweep->candidate_count == sweep->max_candidates) {
+        return;
+    }
+
+    log_debug("Found potential ONVIF device at %s", ip_addr);
+    strcpy(sweep->candidates[sweep->candidate_count++], ip_addr);
+    send_probes(sweep, ip);
+}
+
+/**
+ * Start a non-blocking connect
+ *
+ * @return 1 if the connect is in flight, 0 if it finished at once, -1 if it failed
+ */
+static int start_connect(sweep_t *sweep, sweep_connect_t *slot, int slot_index, uint32_t ip, uint16_t port) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(ip);
+
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+        close(fd);
+        return 0;
+    }
+    if (errno != EINPROGRESS) {
+        close(fd);
+        return -1;
+    }
+
+    struct epoll_event ev = { .events = EPOLLOUT, .data.u32 = (uint32_t)slot_index };
+    if (epoll_ctl(sweep->epfd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+        close(fd);
+        return -1;
+    }
+    slot->fd = fd;
+    slot->ip = ip;
+    slot->deadline_ms = sweep_now_ms() + ONVIF_SWEEP_CONNECT_TIMEOUT_MS;
+    return 1;
+}
+
+/**
+ * Read every ProbeMatch waiting on the UDP socket
+ */
+static void receive_responses(sweep_t *sweep, char *buffer) {
+    while (sweep->device_count < sweep->max_devices) {
+        struct sockaddr_in addr;
+        socklen_t addr_len = sizeof(addr);
+        ssize_t ret = recvfrom(sweep->udp, buffer, SWEEP_RECV_BUFFER_SIZE - 1, 0,
+                               (struct sockaddr *)&addr, &addr_len);
+        if (ret < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                log_warn("Failed to receive discovery response: %s", strerror(errno));
+            }
+            if (errno != EINTR) {
+                return;
+            }
+            continue;
+        }
+        buffer[ret] = '\0';
+
+        onvif_device_info_t *device = &sweep->devices[sweep->device_count];
+        if (parse_device_info(buffer, device) != 0) {
+            log_debug("Failed to parse device info from response of %s", inet_ntoa(addr.sin_addr));
+            continue;
+        }
+
+        bool duplicate = false;
+        for (int j = 0; j < sweep->device_count && !duplicate; j++) {
+            duplicate = strcmp(sweep->devices[j].ip_address, device->ip_address) == 0;
+        }
+        if (!duplicate) {
+            log_info("Discovered ONVIF device: %s (%s)", device->device_service, device->ip_address);
+            sweep->device_count++;
+        }
+    }
+}
+
+static void finish_connect(sweep_t *sweep, sweep_connect_t *slot, bool check) {
+    if (check) {
+        int so_error = 0;
+        socklen_t len = sizeof(so_error);
+        if (getsockopt(slot->fd, SOL_SOCKET, SO_ERROR, &so_error, &len) == 0 && so_error == 0) {
+            host_found(sweep, slot->ip);
+        }
+    }
+    close(slot->fd);
+    slot->fd = -1;
+}
+
+// Sweep a range of addresses for ONVIF devices
+int onvif_discovery_sweep(uint32_t first_ip, uint32_t last_ip, uint32_t broadcast,
+                          char candidates[][16], int max_candidates, int *candidate_count,
+                          onvif_device_info_t *devices, int max_devices) {
+    *candidate_count = 0;
+    if (last_ip < first_ip || !devices || max_devices <= 0) {
+        return 0;
+    }
+
+    sweep_t sweep = {
+        .epfd = -1,
+        .udp = -1,
+        .candidates = candidates,
+        .max_candidates = max_candidates,
+        .devices = devices,
+        .max_devices = max_devices
+    };
+    sweep_connect_t slots[ONVIF_SWEEP_MAX_IN_FLIGHT];
+    for (int i = 0; i < ONVIF_SWEEP_MAX_IN_FLIGHT; i++) {
+        slots[i].fd = -1;
+    }
+    char *buffer = malloc(SWEEP_RECV_BUFFER_SIZE);
+    int result = -1;
+
+    sweep.epfd = epoll_create1(EPOLL_CLOEXEC);
+    sweep.udp = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (!buffer || sweep.epfd < 0 || sweep.udp < 0) {
+        log_error("Failed to set up ONVIF discovery sweep: %s", strerror(errno));
+        goto cleanup;
+    }
+
+    int enabled = 1;
+    if (setsockopt(sweep.udp, SOL_SOCKET, SO_BROADCAST, &enabled, sizeof(enabled)) < 0) {
+        log_warn("Failed to set SO_BROADCAST option: %s", strerror(errno));
+    }
+    // Replies arrive in bursts once many hosts are probed
+    int rcvbuf = 512 * 1024;
+    setsockopt(sweep.udp, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+    struct epoll_event udp_ev = { .events = EPOLLIN, .data.u32 = SWEEP_UDP_TAG };
+    if (epoll_ctl(sweep.epfd, EPOLL_CTL_ADD, sweep.udp, &udp_ev) != 0) {
+        log_error("Failed to watch discovery socket: %s", strerror(errno));
+        goto cleanup;
+    }
+
+    // Devices that answer multicast or broadcast need no port check
+    send_probes(&sweep, broadcast);
+    struct in_addr multicast;
+    inet_pton(AF_INET, "239.255.255.250", &multicast);
+    send_probes(&sweep, ntohl(multicast.s_addr));
+
+    uint64_t target_count = ((uint64_t)last_ip - first_ip + 1) * SWEEP_PORT_COUNT;
+    uint64_t next_target = 0;
+    int in_flight = 0;
+    int64_t start_ms = sweep_now_ms();
+    int64_t end_ms = start_ms + ONVIF_SWEEP_TIMEOUT_MS;
+
+    log_info("Sweeping %llu addresses for ONVIF devices",
+             (unsigned long long)(target_count / SWEEP_PORT_COUNT));
+
+    while (sweep.device_count < max_devices) {
+        int64_t now = sweep_now_ms();
+        if (now >= end_ms) {
+            log_warn("ONVIF discovery sweep timed out after %d ms", ONVIF_SWEEP_TIMEOUT_MS);
+            break;
+        }
+
+        // Start connects as the rate and the in-flight limit allow, with a
+        // tenth of a second's worth straight away
+        uint64_t allowed = (uint64_t)(now - start_ms) * ONVIF_SWEEP_RATE / 1000 + ONVIF_SWEEP_RATE / 10;
+        for (int i = 0; i < ONVIF_SWEEP_MAX_IN_FLIGHT && next_target < target_count && next_target < allowed; i++) {
+            if (slots[i].fd >= 0) {
+                continue;
+            }
+            uint32_t ip = first_ip + (uint32_t)(next_target / SWEEP_PORT_COUNT);
+            uint16_t port = sweep_ports[next_target % SWEEP_PORT_COUNT];
+            next_target++;
+
+            int started = start_connect(&sweep, &slots[i], i, ip, port);
+            if (started > 0) {
+                in_flight++;
+            } else if (started == 0) {
+                host_found(&sweep, ip);
+            }
+        }
+
+        // Done once every port is checked and the last probe had time for answers
+        int64_t response_end = sweep.last_probe_ms + ONVIF_SWEEP_RESPONSE_WAIT_MS;
+        if (next_target >= target_count && in_flight == 0 && now >= response_end) {
+            break;
+        }
+
+        // Sleep until the next connect may start, times out, or the wait ends
+        int64_t wake = end_ms;
+        if (next_target < target_count && in_flight < ONVIF_SWEEP_MAX_IN_FLIGHT) {
+            int64_t next_start = start_ms + ((int64_t)next_target + 1 - ONVIF_SWEEP_RATE / 10) * 1000 / ONVIF_SWEEP_RATE;
+            wake = next_start < wake ? next_start : wake;
+        }
+        for (int i = 0; i < ONVIF_SWEEP_MAX_IN_FLIGHT; i++) {
+            if (slots[i].fd >= 0 && slots[i].deadline_ms < wake) {
+                wake = slots[i].deadline_ms;
+            }
+        }
+        if (next_target >= target_count && in_flight == 0 && response_end < wake) {
+            wake = response_end;
+        }
+        int timeout = wake > now ? (int)(wake - now) : 0;
+
+        struct epoll_event events[64];
+        int n = epoll_wait(sweep.epfd, events, 64, timeout);
+        if (n < 0 && errno != EINTR) {
+            log_error("ONVIF discovery sweep failed: %s", strerror(errno));
+            break;
+        }
+        for (int e = 0; e < n; e++) {
+            uint32_t tag = events[e].data.u32;
+            if (tag == SWEEP_UDP_TAG) {
+                receive_responses(&sweep, buffer);
+            } else if (slots[tag].fd >= 0) {
+                finish_connect(&sweep, &slots[tag], true);
+                in_flight--;
+            }
+        }
+
+        // Ports that did not answer in time count as closed
+        now = sweep_now_ms();
+        for (int i = 0; i < ONVIF_SWEEP_MAX_IN_FLIGHT; i++) {
+            if (slots[i].fd >= 0 && slots[i].deadline_ms <= now) {
+                finish_connect(&sweep, &slots[i], false);
+                in_flight--;
+            }
+        }
+    }
+
+    log_info("ONVIF discovery sweep found %d hosts with open ports and %d devices in %lld ms",
+             sweep.candidate_count, sweep.device_count, (long long)(sweep_now_ms() - start_ms));
+    result = sweep.device_count;
+
+cleanup:
+    for (int i = 0; i < ONVIF_SWEEP_MAX_IN_FLIGHT; i++) {
+        if (slots[i].fd >= 0) {
+            close(slots[i].fd);
+        }
+    }
+    if (sweep.udp >= 0) {
+        close(sweep.udp);
+    }
+    if (sweep.epfd >= 0) {
+        close(sweep.epfd);
+    }
+    free(buffer);
+    *candidate_count = sweep.candidate_count;
+    return result;
+}
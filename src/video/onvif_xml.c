@@ -0,0 +1,294 @@
+#include "video/onvif_xml.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+// Find a string in the rest of the buffer
+static const char *find_str(const char *pos, const char *end, const char *str) {
+    size_t len = strlen(str);
+    while ((size_t)(end - pos) >= len) {
+        const char *hit = memchr(pos, str[0], (size_t)(end - pos) - len + 1);
+        if (!hit) {
+            return NULL;
+        }
+        if (memcmp(hit, str, len) == 0) {
+            return hit;
+        }
+        pos = hit + 1;
+    }
+    return NULL;
+}
+
+static bool starts_with(const char *pos, const char *end, const char *str) {
+    size_t len = strlen(str);
+    return (size_t)(end - pos) >= len && memcmp(pos, str, len) == 0;
+}
+
+// Strip the namespace prefix from a name
+static onvif_xml_slice_t local_name(const char *name, size_t len) {
+    const char *colon = memchr(name, ':', len);
+    if (colon) {
+        len -= (size_t)(colon + 1 - name);
+        name = colon + 1;
+    }
+    return (onvif_xml_slice_t){ name, len };
+}
+
+static bool slice_is(onvif_xml_slice_t slice, const char *str, size_t len) {
+    return slice.len == len && memcmp(slice.ptr, str, len) == 0;
+}
+
+// Start reading a buffer
+void onvif_xml_init(onvif_xml_reader_t *reader, const char *xml, size_t len) {
+    memset(reader, 0, sizeof(*reader));
+    reader->pos = xml;
+    reader->end = xml + len;
+}
+
+// Read up to the next event
+onvif_xml_event_t onvif_xml_next(onvif_xml_reader_t *reader) {
+    if (reader->pop_pending) {
+        reader->pop_pending = false;
+        reader->depth--;
+    }
+    if (reader->close_empty) {
+        reader->close_empty = false;
+        reader->pop_pending = true;
+        return ONVIF_XML_END;
+    }
+
+    const char *end = reader->end;
+    while (reader->pos < end) {
+        const char *pos = reader->pos;
+
+        if (*pos != '<') {
+            const char *next = memchr(pos, '<', (size_t)(end - pos));
+            if (!next) {
+                next = end;
+            }
+            reader->pos = next;
+            for (const char *c = pos; c < next; c++) {
+                if (!isspace((unsigned char)*c)) {
+                    reader->text = (onvif_xml_slice_t){ pos, (size_t)(next - pos) };
+                    return ONVIF_XML_TEXT;
+                }
+            }
+            continue;
+        }
+
+        if (starts_with(pos, end, "<!--")) {
+            const char *close = find_str(pos + 4, end, "-->");
+            if (!close) {
+                return ONVIF_XML_ERROR;
+            }
+            reader->pos = close + 3;
+            continue;
+        }
+
+        if (starts_with(pos, end, "<![CDATA[")) {
+            const char *close = find_str(pos + 9, end, "]]>");
+            if (!close) {
+                return ONVIF_XML_ERROR;
+            }
+            reader->pos = close + 3;
+            reader->text = (onvif_xml_slice_t){ pos + 9, (size_t)(close - pos - 9) };
+            return ONVIF_XML_TEXT;
+        }
+
+        if (starts_with(pos, end, "<?") || starts_with(pos, end, "<!")) {
+            const char *close = memchr(pos, '>', (size_t)(end - pos));
+            if (!close) {
+                return ONVIF_XML_ERROR;
+            }
+            reader->pos = close + 1;
+            continue;
+        }
+
+        if (starts_with(pos, end, "</")) {
+            const char *close = memchr(pos, '>', (size_t)(end - pos));
+            if (!close || reader->depth == 0) {
+                return ONVIF_XML_ERROR;
+            }
+            reader->pos = close + 1;
+            reader->pop_pending = true;
+            return ONVIF_XML_END;
+        }
+
+        // Start tag; '>' may appear inside quoted attribute values
+        const char *name = pos + 1;
+        const char *name_end = name;
+        while (name_end < end && !isspace((unsigned char)*name_end) && *name_end != '/' && *name_end != '>') {
+            name_end++;
+        }
+        const char *close = name_end;
+        char quote = 0;
+        while (close < end && (quote || *close != '>')) {
+            if (quote && *close == quote) {
+                quote = 0;
+            } else if (!quote && (*close == '"' || *close == '\'')) {
+                quote = *close;
+            }
+            close++;
+        }
+        if (close >= end || name_end == name) {
+            return ONVIF_XML_ERROR;
+        }
+
+        bool empty = close[-1] == '/';
+        const char *attrs_end = empty ? close - 1 : close;
+        reader->attrs = (onvif_xml_slice_t){ name_end, attrs_end > name_end ? (size_t)(attrs_end - name_end) : 0 };
+        reader->pos = close + 1;
+        reader->close_empty = empty;
+
+        if (reader->depth < ONVIF_XML_MAX_DEPTH) {
+            reader->stack[reader->depth] = local_name(name, (size_t)(name_end - name));
+        }
+        reader->depth++;
+        return ONVIF_XML_START;
+    }
+
+    return ONVIF_XML_EOF;
+}
+
+// Check the local name of the current element
+bool onvif_xml_name_is(const onvif_xml_reader_t *reader, const char *name) {
+    if (reader->depth == 0 || reader->depth > ONVIF_XML_MAX_DEPTH) {
+        return false;
+    }
+    return slice_is(reader->stack[reader->depth - 1], name, strlen(name));
+}
+
+// Check the innermost elements against a path
+bool onvif_xml_path_is(const onvif_xml_reader_t *reader, const char *path) {
+    if (reader->depth > ONVIF_XML_MAX_DEPTH) {
+        return false;
+    }
+
+    // Compare segments from the last one outwards
+    const char *seg_end = path + strlen(path);
+    int level = reader->depth - 1;
+    while (seg_end > path) {
+        const char *seg = seg_end;
+        while (seg > path && seg[-1] != '/') {
+            seg--;
+        }
+        if (level < 0 || !slice_is(reader->stack[level], seg, (size_t)(seg_end - seg))) {
+            return false;
+        }
+        level--;
+        seg_end = seg > path ? seg - 1 : path;
+    }
+    return true;
+}
+
+/**
+ * Copy a slice, decoding entities and trimming whitespace
+ */
+static size_t copy_decoded(onvif_xml_slice_t slice, char *buffer, size_t size) {
+    const char *pos = slice.ptr;
+    const char *end = slice.ptr + slice.len;
+    size_t len = 0;
+
+    if (size == 0) {
+        return 0;
+    }
+
+    while (pos < end && isspace((unsigned char)*pos)) {
+        pos++;
+    }
+    while (end > pos && isspace((unsigned char)end[-1])) {
+        end--;
+    }
+
+    while (pos < end && len + 1 < size) {
+        char c = *pos++;
+        if (c == '&') {
+            const char *semi = memchr(pos, ';', (size_t)(end - pos));
+            if (semi && semi - pos <= 8) {
+                size_t n = (size_t)(semi - pos);
+                if (n == 3 && memcmp(pos, "amp", 3) == 0) {
+                    c = '&';
+                } else if (n == 2 && memcmp(pos, "lt", 2) == 0) {
+                    c = '<';
+                } else if (n == 2 && memcmp(pos, "gt", 2) == 0) {
+                    c = '>';
+                } else if (n == 4 && memcmp(pos, "quot", 4) == 0) {
+                    c = '"';
+                } else if (n == 4 && memcmp(pos, "apos", 4) == 0) {
+                    c = '\'';
+                } else if (n > 1 && pos[0] == '#') {
+                    // Character references outside ASCII are left as they are
+                    long code = pos[1] == 'x' ? strtol(pos + 2, NULL, 16) : strtol(pos + 1, NULL, 10);
+                    if (code <= 0 || code > 127) {
+                        buffer[len++] = '&';
+                        continue;
+                    }
+                    c = (char)code;
+                } else {
+                    buffer[len++] = '&';
+                    continue;
+                }
+                pos = semi + 1;
+            }
+        }
+        buffer[len++] = c;
+    }
+
+    buffer[len] = '\0';
+    return len;
+}
+
+// Copy the text of the last text event
+size_t onvif_xml_copy_text(const onvif_xml_reader_t *reader, char *buffer, size_t size) {
+    return copy_decoded(reader->text, buffer, size);
+}
+
+// Copy an attribute of the last start tag
+bool onvif_xml_copy_attr(const onvif_xml_reader_t *reader, const char *name, char *buffer, size_t size) {
+    const char *pos = reader->attrs.ptr;
+    const char *end = pos + reader->attrs.len;
+    size_t name_len = strlen(name);
+
+    while (pos < end) {
+        while (pos < end && isspace((unsigned char)*pos)) {
+            pos++;
+        }
+        const char *attr = pos;
+        while (pos < end && *pos != '=' && !isspace((unsigned char)*pos)) {
+            pos++;
+        }
+        onvif_xml_slice_t attr_name = local_name(attr, (size_t)(pos - attr));
+        while (pos < end && (isspace((unsigned char)*pos) || *pos == '=')) {
+            pos++;
+        }
+        if (pos >= end || (*pos != '"' && *pos != '\'')) {
+            return false;
+        }
+        const char *value_end = memchr(pos + 1, *pos, (size_t)(end - pos - 1));
+        if (!value_end) {
+            return false;
+        }
+        if (slice_is(attr_name, name, name_len)) {
+            copy_decoded((onvif_xml_slice_t){ pos + 1, (size_t)(value_end - pos - 1) }, buffer, size);
+            return true;
+        }
+        pos = value_end + 1;
+    }
+    return false;
+}
+
+// Find the text of the first element matching a path
+bool onvif_xml_find_text(const char *xml, size_t len, const char *path, char *buffer, size_t size) {
+    onvif_xml_reader_t reader;
+    onvif_xml_event_t event;
+
+    onvif_xml_init(&reader, xml, len);
+    while ((event = onvif_xml_next(&reader)) != ONVIF_XML_EOF && event != ONVIF_XML_ERROR) {
+        if (event == ONVIF_XML_TEXT && onvif_xml_path_is(&reader, path)) {
+            onvif_xml_copy_text(&reader, buffer, size);
+            return true;
+        }
+    }
+    return false;
+}
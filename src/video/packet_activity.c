@@ -0,0 +1,64 @@
+#include <math.h>
+
+#include "video/packet_activity.h"
+
+// Packets averaged plainly before the baseline counts as learnt
+#define LEARN_PACKETS 100
+
+// Weights of a new packet in the slow baseline and the fast average. While
+// the stream is active the baseline moves far slower, so lasting motion
+// does not become the baseline, while a lasting change of the scene (rain,
+// lights switched on) still is absorbed within minutes.
+#define BASELINE_WEIGHT (1.0f / 256.0f)
+#define ACTIVE_BASELINE_WEIGHT (1.0f / 4096.0f)
+#define RECENT_WEIGHT (1.0f / 4.0f)
+
+// The fast average must exceed the baseline by this many deviations and by
+// this ratio; the ratio keeps encoders with almost no noise from flagging
+// every slight change
+#define SPIKE_DEVIATIONS 3.0f
+#define SPIKE_MIN_RATIO 1.25f
+
+// Start learning the baseline over
+void packet_activity_reset(packet_activity_t *activity, int64_t now_ms) {
+    activity->mean = 0.0f;
+    activity->deviation = 0.0f;
+    activity->recent = 0.0f;
+    activity->samples = 0;
+    atomic_store_explicit(&activity->last_active_ms, now_ms, memory_order_relaxed);
+}
+
+// Account for a non-key video packet
+bool packet_activity_update(packet_activity_t *activity, int size, int64_t now_ms) {
+    float value = (float)size;
+
+    if (activity->samples < LEARN_PACKETS) {
+        activity->samples++;
+        float weight = 1.0f / (float)activity->samples;
+        activity->mean += (value - activity->mean) * weight;
+        activity->deviation += (fabsf(value - activity->mean) - activity->deviation) * weight;
+        activity->recent = activity->mean;
+        atomic_store_explicit(&activity->last_active_ms, now_ms, memory_order_relaxed);
+        return true;
+    }
+
+    activity->recent += (value - activity->recent) * RECENT_WEIGHT;
+    bool active = activity->recent > activity->mean + SPIKE_DEVIATIONS * activity->deviation &&
+                  activity->recent > activity->mean * SPIKE_MIN_RATIO;
+
+    float weight = active ? ACTIVE_BASELINE_WEIGHT : BASELINE_WEIGHT;
+    activity->mean += (value - activity->mean) * weight;
+    activity->deviation += (fabsf(value - activity->mean) - activity->deviation) * weight;
+
+    if (active) {
+        atomic_store_explicit(&activity->last_active_ms, now_ms, memory_order_relaxed);
+    }
+    return active;
+}
+
+// Check whether a stream showed activity recently
+bool packet_activity_recent(const packet_activity_t *activity, int64_t now_ms, int64_t hold_ms) {
+    // The load does not modify the estimator, the cast only drops const for older compilers
+    int64_t last = atomic_load_explicit(&((packet_activity_t *)activity)->last_active_ms, memory_order_relaxed);
+    return now_ms - last <= hold_ms;
+}
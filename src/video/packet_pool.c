@@ -0,0 +1,367 @@
+/**
+ * Packet and Frame Pool
+ *
+ * Mutex-protected free lists per stream. The lists are short and the
+ * critical sections only push or pop a pointer, so contention between the
+ * threads of a stream stays negligible compared to the allocations saved.
+ * Pools are allocated on first use and never freed, because decoders and
+ * writers keep using their pool pointer until they are torn down.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libavcodec/avcodec.h>
+#include <libavutil/buffer.h>
+#include <libavutil/frame.h>
+
+#include "core/logger.h"
+#include "utils/memory.h"
+#include "video/packet_pool.h"
+
+// av_buffer_pool allocator sizes became size_t in libavutil 57
+#if LIBAVUTIL_VERSION_MAJOR >= 57
+typedef size_t pool_size_t;
+#else
+typedef int pool_size_t;
+#endif
+
+static packet_pool_t *pools[MAX_STREAMS];
+static pthread_mutex_t pools_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Free a payload buffer once its pool lets go of it
+ */
+static void payload_free(void *opaque, uint8_t *data) {
+    memory_track(MEMORY_TAG_INGEST, (size_t)(uintptr_t)opaque, false);
+    av_free(data);
+}
+
+/**
+ * Allocator for the payload pools, counting every buffer that is not reused
+ */
+static AVBufferRef *payload_alloc(void *opaque, pool_size_t size) {
+    packet_pool_t *pool = (packet_pool_t *)opaque;
+    atomic_fetch_add(&pool->payload_misses, 1);
+
+    uint8_t *data = av_malloc(size);
+    if (!data) {
+        return NULL;
+    }
+    AVBufferRef *buf = av_buffer_create(data, size, payload_free, (void *)(uintptr_t)size, 0);
+    if (!buf) {
+        av_free(data);
+        return NULL;
+    }
+    memory_track(MEMORY_TAG_INGEST, (size_t)size, true);
+    return buf;
+}
+
+/**
+ * Get the pool of a stream, creating it on first use
+ */
+packet_pool_t *packet_pool_acquire(const char *stream_name) {
+    if (!stream_name || stream_name[0] == '\0') {
+        return NULL;
+    }
+
+    int free_slot = -1;
+    packet_pool_t *result = NULL;
+
+    pthread_mutex_lock(&pools_mutex);
+    for (int i = 0; i < MAX_STREAMS; i++) {
+        if (pools[i] && pools[i]->in_use) {
+            if (strcmp(pools[i]->stream_name, stream_name) == 0) {
+                result = pools[i];
+                break;
+            }
+        } else if (free_slot < 0) {
+            free_slot = i;
+        }
+    }
+
+    if (!result && free_slot >= 0 && !pools[free_slot]) {
+        pools[free_slot] = malloc(sizeof(packet_pool_t));
+        if (!pools[free_slot]) {
+            log_error("Failed to allocate packet pool for stream %s", stream_name);
+        }
+    }
+
+    if (!result && free_slot >= 0 && pools[free_slot]) {
+        packet_pool_t *free_pool = pools[free_slot];
+        memset(free_pool, 0, sizeof(packet_pool_t));
+        strncpy(free_pool->stream_name, stream_name, MAX_STREAM_NAME - 1);
+        free_pool->stream_name[MAX_STREAM_NAME - 1] = '\0';
+        pthread_mutex_init(&free_pool->mutex, NULL);
+        atomic_init(&free_pool->packet_requests, 0);
+        atomic_init(&free_pool->packet_misses, 0);
+        atomic_init(&free_pool->frame_requests, 0);
+        atomic_init(&free_pool->frame_misses, 0);
+        atomic_init(&free_pool->payload_requests, 0);
+        atomic_init(&free_pool->payload_misses, 0);
+        free_pool->in_use = true;
+        result = free_pool;
+        log_debug("Created packet pool for stream %s", stream_name);
+    }
+    pthread_mutex_unlock(&pools_mutex);
+
+    if (!result) {
+        log_warn("No free packet pool for stream %s, allocating packets directly", stream_name);
+    }
+    return result;
+}
+
+/**
+ * Get an empty packet
+ */
+AVPacket *packet_pool_get_packet(packet_pool_t *pool) {
+    if (!pool) {
+        return av_packet_alloc();
+    }
+
+    atomic_fetch_add(&pool->packet_requests, 1);
+
+    AVPacket *pkt = NULL;
+    pthread_mutex_lock(&pool->mutex);
+    if (pool->packet_count > 0) {
+        pkt = pool->packets[--pool->packet_count];
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    if (!pkt) {
+        atomic_fetch_add(&pool->packet_misses, 1);
+        pkt = av_packet_alloc();
+    }
+    return pkt;
+}
+
+/**
+ * Unreference a packet and return it to the pool
+ */
+void packet_pool_put_packet(packet_pool_t *pool, AVPacket **pkt) {
+    if (!pkt || !*pkt) {
+        return;
+    }
+
+    if (!pool) {
+        av_packet_free(pkt);
+        return;
+    }
+
+    // Drop the payload reference outside the pool lock
+    av_packet_unref(*pkt);
+
+    pthread_mutex_lock(&pool->mutex);
+    if (!pool->closed && pool->packet_count < PACKET_POOL_MAX_PACKETS) {
+        pool->packets[pool->packet_count++] = *pkt;
+        *pkt = NULL;
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    if (*pkt) {
+        av_packet_free(pkt);
+    }
+}
+
+/**
+ * Allocate a padded payload for an empty packet
+ */
+int packet_pool_new_payload(packet_pool_t *pool, AVPacket *pkt, int size) {
+    if (!pkt || size < 0) {
+        return AVERROR(EINVAL);
+    }
+
+    if (!pool) {
+        return av_new_packet(pkt, size);
+    }
+
+    atomic_fetch_add(&pool->payload_requests, 1);
+
+    size_t needed = (size_t)size + AV_INPUT_BUFFER_PADDING_SIZE;
+    int size_class = 0;
+    while (size_class < PACKET_POOL_PAYLOAD_CLASSES &&
+           ((size_t)1 << (PACKET_POOL_MIN_PAYLOAD_SHIFT + size_class)) < needed) {
+        size_class++;
+    }
+
+    AVBufferRef *buf = NULL;
+    bool pooled = false;
+    if (size_class < PACKET_POOL_PAYLOAD_CLASSES) {
+        pthread_mutex_lock(&pool->mutex);
+        if (!pool->closed) {
+            pooled = true;
+            if (!pool->payloads[size_class]) {
+                pool->payloads[size_class] = av_buffer_pool_init2(
+                    (pool_size_t)1 << (PACKET_POOL_MIN_PAYLOAD_SHIFT + size_class), pool, payload_alloc, NULL);
+            }
+            if (pool->payloads[size_class]) {
+                buf = av_buffer_pool_get(pool->payloads[size_class]);
+            }
+        }
+        pthread_mutex_unlock(&pool->mutex);
+    }
+
+    if (!buf) {
+        // Too large for the pool, or the pool is closed
+        if (!pooled) {
+            atomic_fetch_add(&pool->payload_misses, 1);
+        }
+        return av_new_packet(pkt, size);
+    }
+
+    // Same layout as av_new_packet: zeroed padding after the payload
+    memset(buf->data + size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+    pkt->buf = buf;
+    pkt->data = buf->data;
+    pkt->size = size;
+    return 0;
+}
+
+/**
+ * Get an empty frame
+ */
+AVFrame *packet_pool_get_frame(packet_pool_t *pool) {
+    if (!pool) {
+        return av_frame_alloc();
+    }
+
+    atomic_fetch_add(&pool->frame_requests, 1);
+
+    AVFrame *frame = NULL;
+    pthread_mutex_lock(&pool->mutex);
+    if (pool->frame_count > 0) {
+        frame = pool->frames[--pool->frame_count];
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    if (!frame) {
+        atomic_fetch_add(&pool->frame_misses, 1);
+        frame = av_frame_alloc();
+    }
+    return frame;
+}
+
+/**
+ * Unreference a frame and return it to the pool
+ */
+void packet_pool_put_frame(packet_pool_t *pool, AVFrame **frame) {
+    if (!frame || !*frame) {
+        return;
+    }
+
+    if (!pool) {
+        av_frame_free(frame);
+        return;
+    }
+
+    av_frame_unref(*frame);
+
+    pthread_mutex_lock(&pool->mutex);
+    if (!pool->closed && pool->frame_count < PACKET_POOL_MAX_FRAMES) {
+        pool->frames[pool->frame_count++] = *frame;
+        *frame = NULL;
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    if (*frame) {
+        av_frame_free(frame);
+    }
+}
+
+/**
+ * Add the counters of one pool to a stats structure
+ */
+static void add_pool_stats(packet_pool_t *pool, packet_pool_stats_t *stats) {
+    uint64_t packet_misses = atomic_load(&pool->packet_misses);
+    uint64_t frame_misses = atomic_load(&pool->frame_misses);
+    uint64_t payload_misses = atomic_load(&pool->payload_misses);
+    uint64_t packet_requests = atomic_load(&pool->packet_requests);
+    uint64_t frame_requests = atomic_load(&pool->frame_requests);
+    uint64_t payload_requests = atomic_load(&pool->payload_requests);
+
+    stats->packet_misses += packet_misses;
+    stats->frame_misses += frame_misses;
+    stats->payload_misses += payload_misses;
+    stats->packet_hits += packet_requests > packet_misses ? packet_requests - packet_misses : 0;
+    stats->frame_hits += frame_requests > frame_misses ? frame_requests - frame_misses : 0;
+    stats->payload_hits += payload_requests > payload_misses ? payload_requests - payload_misses : 0;
+
+    pthread_mutex_lock(&pool->mutex);
+    stats->packets_free += pool->packet_count;
+    stats->frames_free += pool->frame_count;
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+/**
+ * Get the counters of a stream's pool
+ */
+int packet_pool_get_stats(const char *stream_name, packet_pool_stats_t *stats) {
+    if (!stream_name || !stats) {
+        return -1;
+    }
+
+    memset(stats, 0, sizeof(packet_pool_stats_t));
+
+    int ret = -1;
+    pthread_mutex_lock(&pools_mutex);
+    for (int i = 0; i < MAX_STREAMS; i++) {
+        if (pools[i] && pools[i]->in_use && strcmp(pools[i]->stream_name, stream_name) == 0) {
+            add_pool_stats(pools[i], stats);
+            ret = 0;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&pools_mutex);
+
+    return ret;
+}
+
+/**
+ * Get the counters summed over all pools
+ */
+void packet_pool_get_total_stats(packet_pool_stats_t *stats) {
+    if (!stats) {
+        return;
+    }
+
+    memset(stats, 0, sizeof(packet_pool_stats_t));
+
+    pthread_mutex_lock(&pools_mutex);
+    for (int i = 0; i < MAX_STREAMS; i++) {
+        if (pools[i] && pools[i]->in_use) {
+            add_pool_stats(pools[i], stats);
+        }
+    }
+    pthread_mutex_unlock(&pools_mutex);
+}
+
+/**
+ * Release all pooled memory
+ */
+void packet_pool_cleanup(void) {
+    pthread_mutex_lock(&pools_mutex);
+    for (int i = 0; i < MAX_STREAMS; i++) {
+        packet_pool_t *pool = pools[i];
+        if (!pool || !pool->in_use) {
+            continue;
+        }
+
+        pthread_mutex_lock(&pool->mutex);
+        pool->closed = true;
+        while (pool->packet_count > 0) {
+            av_packet_free(&pool->packets[--pool->packet_count]);
+        }
+        while (pool->frame_count > 0) {
+            av_frame_free(&pool->frames[--pool->frame_count]);
+        }
+        for (int c = 0; c < PACKET_POOL_PAYLOAD_CLASSES; c++) {
+            // Buffers still in use are freed when their last reference goes away
+            av_buffer_pool_uninit(&pool->payloads[c]);
+        }
+        pthread_mutex_unlock(&pool->mutex);
+    }
+    pthread_mutex_unlock(&pools_mutex);
+
+    log_info("Packet pools released");
+}
@@ -0,0 +1,320 @@
+/**
+ * Lock-free Packet Ring
+ *
+ * Single-producer/single-consumer ring of packet references with a GOP-aware
+ * drop policy. The head index is only written by the consumer and the tail
+ * index only by the producer, so neither side ever waits for the other.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+
+#include <libavcodec/avcodec.h>
+
+#include "core/logger.h"
+#include "video/packet_ring.h"
+
+/**
+ * Round up to the next power of two
+ */
+static unsigned int round_up_pow2(unsigned int value) {
+    unsigned int result = 1;
+    while (result < value && result < (1u << 30)) {
+        result <<= 1;
+    }
+    return result;
+}
+
+/**
+ * Number of queued packets as seen by either side
+ */
+static unsigned int ring_used(packet_ring_t *ring) {
+    unsigned int tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    unsigned int head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    return tail - head;
+}
+
+/**
+ * Initialize a packet ring
+ */
+int packet_ring_init(packet_ring_t *ring, int depth, packet_pool_t *pool) {
+    if (!ring || depth <= 0) {
+        return -1;
+    }
+
+    memset(ring, 0, sizeof(packet_ring_t));
+
+    ring->capacity = round_up_pow2((unsigned int)depth);
+    ring->mask = ring->capacity - 1;
+    ring->high_watermark = ring->capacity - ring->capacity / 4;
+    ring->pool = pool;
+
+    ring->entries = calloc(ring->capacity, sizeof(packet_ring_entry_t));
+    if (!ring->entries) {
+        log_error("Failed to allocate packet ring of %u entries", ring->capacity);
+        return -1;
+    }
+
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->waiting, 0);
+    atomic_init(&ring->closed, 0);
+    atomic_init(&ring->packets_pushed, 0);
+    atomic_init(&ring->packets_dropped, 0);
+    atomic_init(&ring->gops_dropped, 0);
+    atomic_init(&ring->overruns, 0);
+    pthread_mutex_init(&ring->wait_mutex, NULL);
+    pthread_cond_init(&ring->wait_cond, NULL);
+
+    return 0;
+}
+
+/**
+ * Release all queued packets and free the ring storage
+ */
+void packet_ring_destroy(packet_ring_t *ring, void (*release_opaque)(void *opaque)) {
+    if (!ring || !ring->entries) {
+        return;
+    }
+
+    void *opaque = NULL;
+    while (packet_ring_pop(ring, NULL, &opaque, NULL) == 0) {
+        if (release_opaque && opaque) {
+            release_opaque(opaque);
+        }
+    }
+
+    free(ring->entries);
+    ring->entries = NULL;
+    pthread_cond_destroy(&ring->wait_cond);
+    pthread_mutex_destroy(&ring->wait_mutex);
+}
+
+/**
+ * Wake the consumer if it is blocked in packet_ring_wait
+ * Called after the new tail was stored.
+ */
+static void wake_consumer(packet_ring_t *ring) {
+    // Pairs with the fence in packet_ring_wait: either the consumer sees the
+    // new tail, or this sees it waiting. A release store followed by a load
+    // may be reordered without it, leaving the packet until the timeout.
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&ring->waiting, memory_order_relaxed)) {
+        pthread_mutex_lock(&ring->wait_mutex);
+        pthread_cond_signal(&ring->wait_cond);
+        pthread_mutex_unlock(&ring->wait_mutex);
+    }
+}
+
+/**
+ * Queue a reference to a packet (producer side)
+ */
+int packet_ring_push(packet_ring_t *ring, const AVPacket *pkt, bool is_video, void *opaque,
+                     const pipeline_trace_t *trace) {
+    if (!ring || !ring->entries || !pkt) {
+        return -1;
+    }
+
+    bool is_keyframe = is_video && (pkt->flags & AV_PKT_FLAG_KEY);
+    unsigned int used = ring_used(ring);
+
+    // Skip the rest of a shed GOP; resume on the next key frame
+    if (ring->dropping) {
+        if (!is_keyframe) {
+            atomic_fetch_add(&ring->packets_dropped, 1);
+            return 1;
+        }
+        ring->dropping = false;
+    }
+
+    if (used >= ring->capacity) {
+        // Full: drop the whole GOP, key frame included
+        ring->dropping = true;
+        atomic_fetch_add(&ring->packets_dropped, 1);
+        atomic_fetch_add(&ring->overruns, 1);
+        if (is_keyframe) {
+            atomic_fetch_add(&ring->gops_dropped, 1);
+        }
+        return 1;
+    }
+
+    if (used >= ring->high_watermark && !is_keyframe) {
+        // Under pressure: shed non-key frames first, keep admitting key frames
+        ring->dropping = true;
+        atomic_fetch_add(&ring->packets_dropped, 1);
+        atomic_fetch_add(&ring->overruns, 1);
+        return 1;
+    }
+
+    AVPacket *ref = packet_pool_get_packet(ring->pool);
+    if (!ref) {
+        atomic_fetch_add(&ring->packets_dropped, 1);
+        return -1;
+    }
+
+    // av_packet_ref only takes a reference on the reader's buffer
+    if (av_packet_ref(ref, pkt) < 0) {
+        packet_pool_put_packet(ring->pool, &ref);
+        atomic_fetch_add(&ring->packets_dropped, 1);
+        return -1;
+    }
+
+    unsigned int tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    packet_ring_entry_t *entry = &ring->entries[tail & ring->mask];
+    entry->pkt = ref;
+    entry->opaque = opaque;
+    if (trace) {
+        entry->trace = *trace;
+    } else {
+        memset(&entry->trace, 0, sizeof(entry->trace));
+    }
+
+    // Publish the entry before the consumer can see the new tail
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+    atomic_fetch_add(&ring->packets_pushed, 1);
+
+    wake_consumer(ring);
+    return 0;
+}
+
+/**
+ * Look at the oldest entry without removing it (consumer side)
+ */
+packet_ring_entry_t *packet_ring_peek(packet_ring_t *ring) {
+    if (!ring || !ring->entries) {
+        return NULL;
+    }
+
+    unsigned int head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    unsigned int tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (head == tail) {
+        return NULL;
+    }
+
+    return &ring->entries[head & ring->mask];
+}
+
+/**
+ * Remove the oldest entry (consumer side)
+ */
+int packet_ring_pop(packet_ring_t *ring, AVPacket *pkt, void **opaque, pipeline_trace_t *trace) {
+    packet_ring_entry_t *entry = packet_ring_peek(ring);
+    if (!entry) {
+        return -1;
+    }
+
+    if (pkt) {
+        av_packet_move_ref(pkt, entry->pkt);
+    }
+    packet_pool_put_packet(ring->pool, &entry->pkt);
+
+    if (opaque) {
+        *opaque = entry->opaque;
+    }
+    entry->opaque = NULL;
+    if (trace) {
+        *trace = entry->trace;
+    }
+
+    // Hand the slot back to the producer only after it has been emptied
+    unsigned int head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+
+    return 0;
+}
+
+/**
+ * Wait until the ring has a packet or is closed (consumer side)
+ */
+bool packet_ring_wait(packet_ring_t *ring, int timeout_ms) {
+    if (!ring) {
+        return false;
+    }
+
+    if (ring_used(ring) > 0) {
+        return true;
+    }
+
+    if (timeout_ms <= 0 || atomic_load(&ring->closed)) {
+        return false;
+    }
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&ring->wait_mutex);
+    atomic_store_explicit(&ring->waiting, 1, memory_order_relaxed);
+    // Pairs with the fence in wake_consumer before the tail is checked again
+    atomic_thread_fence(memory_order_seq_cst);
+    while (ring_used(ring) == 0 && !atomic_load(&ring->closed)) {
+        if (pthread_cond_timedwait(&ring->wait_cond, &ring->wait_mutex, &deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+    atomic_store(&ring->waiting, 0);
+    pthread_mutex_unlock(&ring->wait_mutex);
+
+    return ring_used(ring) > 0;
+}
+
+/**
+ * Close the ring and wake a waiting consumer
+ */
+void packet_ring_close(packet_ring_t *ring) {
+    if (!ring || !ring->entries) {
+        return;
+    }
+
+    pthread_mutex_lock(&ring->wait_mutex);
+    atomic_store(&ring->closed, 1);
+    pthread_cond_broadcast(&ring->wait_cond);
+    pthread_mutex_unlock(&ring->wait_mutex);
+}
+
+/**
+ * Check whether the ring has been closed
+ */
+bool packet_ring_is_closed(packet_ring_t *ring) {
+    return ring && atomic_load(&ring->closed);
+}
+
+/**
+ * Get the number of queued packets
+ */
+int packet_ring_count(packet_ring_t *ring) {
+    if (!ring || !ring->entries) {
+        return 0;
+    }
+
+    return (int)ring_used(ring);
+}
+
+/**
+ * Get the ring counters
+ */
+void packet_ring_get_stats(packet_ring_t *ring, packet_ring_stats_t *stats) {
+    if (!stats) {
+        return;
+    }
+
+    memset(stats, 0, sizeof(packet_ring_stats_t));
+    if (!ring || !ring->entries) {
+        return;
+    }
+
+    stats->packets_pushed = atomic_load(&ring->packets_pushed);
+    stats->packets_dropped = atomic_load(&ring->packets_dropped);
+    stats->gops_dropped = atomic_load(&ring->gops_dropped);
+    stats->overruns = atomic_load(&ring->overruns);
+    stats->capacity = (int)ring->capacity;
+    stats->used = (int)ring_used(ring);
+}
@@ -0,0 +1,231 @@
+/**
+ * Pre-detection Buffer
+ *
+ * Singly linked FIFO of packet references trimmed by whole GOPs. The buffer
+ * is owned by one thread; callers provide any locking they need.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libavcodec/avcodec.h>
+#include <libavutil/avutil.h>
+#include <libavutil/time.h>
+#include <libavutil/mathematics.h>
+
+#include "core/logger.h"
+#include "video/preroll_buffer.h"
+
+/**
+ * Free one entry and its packet
+ */
+static void free_entry(preroll_buffer_t *buffer, preroll_entry_t *entry) {
+    if (entry->pkt) {
+        buffer->bytes -= (size_t)entry->pkt->size;
+        packet_pool_put_packet(buffer->pool, &entry->pkt);
+    }
+    if (entry->opaque && buffer->release_opaque) {
+        buffer->release_opaque(entry->opaque);
+    }
+    free(entry);
+}
+
+/**
+ * Drop the oldest GOP, leaving the buffer starting on the next key frame
+ */
+static void drop_oldest_gop(preroll_buffer_t *buffer) {
+    preroll_entry_t *entry = buffer->head;
+    if (!entry) {
+        return;
+    }
+
+    // Remove the GOP start itself, then everything up to the next GOP start
+    do {
+        preroll_entry_t *next = entry->next;
+        free_entry(buffer, entry);
+        buffer->count--;
+        entry = next;
+    } while (entry && !entry->gop_start);
+
+    buffer->head = entry;
+    if (!entry) {
+        buffer->tail = NULL;
+    }
+    buffer->gop_count--;
+}
+
+/**
+ * Find the start of the second GOP (the trim candidate's successor)
+ */
+static preroll_entry_t *second_gop_start(preroll_buffer_t *buffer) {
+    if (!buffer->head) {
+        return NULL;
+    }
+
+    for (preroll_entry_t *entry = buffer->head->next; entry; entry = entry->next) {
+        if (entry->gop_start) {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Initialize a pre-detection buffer
+ */
+void preroll_buffer_init(preroll_buffer_t *buffer, int seconds, void (*release_opaque)(void *opaque),
+                         packet_pool_t *pool) {
+    if (!buffer) {
+        return;
+    }
+
+    memset(buffer, 0, sizeof(preroll_buffer_t));
+    buffer->seconds = seconds > 0 ? seconds : 0;
+    buffer->release_opaque = release_opaque;
+    buffer->pool = pool;
+}
+
+/**
+ * Change the duration kept by the buffer
+ */
+void preroll_buffer_set_duration(preroll_buffer_t *buffer, int seconds) {
+    if (!buffer) {
+        return;
+    }
+
+    buffer->seconds = seconds > 0 ? seconds : 0;
+    if (!preroll_buffer_enabled(buffer)) {
+        preroll_buffer_clear(buffer);
+    }
+}
+
+/**
+ * Keep the newest GOP even when no duration is set
+ */
+void preroll_buffer_set_gop_cache(preroll_buffer_t *buffer, bool enabled) {
+    if (!buffer) {
+        return;
+    }
+
+    buffer->gop_cache = enabled;
+    if (!preroll_buffer_enabled(buffer)) {
+        preroll_buffer_clear(buffer);
+    }
+}
+
+/**
+ * Check whether the buffer keeps packets at all
+ */
+bool preroll_buffer_enabled(const preroll_buffer_t *buffer) {
+    return buffer && (buffer->seconds > 0 || buffer->gop_cache);
+}
+
+/**
+ * Get the start of the newest GOP in the buffer
+ */
+preroll_entry_t *preroll_buffer_newest_gop(const preroll_buffer_t *buffer) {
+    if (!buffer) {
+        return NULL;
+    }
+
+    preroll_entry_t *newest = NULL;
+    for (preroll_entry_t *entry = buffer->head; entry; entry = entry->next) {
+        if (entry->gop_start) {
+            newest = entry;
+        }
+    }
+    return newest;
+}
+
+/**
+ * Add a reference to a packet, dropping whole GOPs that are no longer needed
+ */
+int preroll_buffer_add(preroll_buffer_t *buffer, const AVPacket *pkt, bool is_video,
+                       AVRational time_base, void *opaque) {
+    if (!buffer || !pkt) {
+        return -1;
+    }
+
+    if (!preroll_buffer_enabled(buffer)) {
+        return 1;
+    }
+
+    bool is_keyframe = is_video && (pkt->flags & AV_PKT_FLAG_KEY);
+
+    // The buffer must always start on a key frame to be decodable
+    if (!buffer->head && !is_keyframe) {
+        return 1;
+    }
+
+    preroll_entry_t *entry = calloc(1, sizeof(preroll_entry_t));
+    if (!entry) {
+        return -1;
+    }
+
+    entry->pkt = packet_pool_get_packet(buffer->pool);
+    if (!entry->pkt || av_packet_ref(entry->pkt, pkt) < 0) {
+        packet_pool_put_packet(buffer->pool, &entry->pkt);
+        free(entry);
+        return -1;
+    }
+
+    entry->opaque = opaque;
+    entry->gop_start = is_keyframe;
+    if (is_video) {
+        int64_t ts = pkt->dts != AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
+        entry->ts_us = (ts != AV_NOPTS_VALUE) ? av_rescale_q(ts, time_base, AV_TIME_BASE_Q)
+                                              : av_gettime_relative();
+        buffer->newest_video_us = entry->ts_us;
+    }
+
+    if (buffer->tail) {
+        buffer->tail->next = entry;
+    } else {
+        buffer->head = entry;
+    }
+    buffer->tail = entry;
+    buffer->count++;
+    buffer->bytes += (size_t)pkt->size;
+    if (is_keyframe) {
+        buffer->gop_count++;
+    }
+
+    // Drop the oldest GOP as long as the remaining ones still cover the duration;
+    // without a duration only the newest GOP is left
+    int64_t keep_us = (int64_t)buffer->seconds * 1000000LL;
+    preroll_entry_t *second;
+    while (buffer->gop_count > 1 && (second = second_gop_start(buffer)) != NULL) {
+        int64_t covered_us = buffer->newest_video_us - second->ts_us;
+        if (covered_us < keep_us && buffer->bytes <= PREROLL_MAX_BYTES) {
+            break;
+        }
+        drop_oldest_gop(buffer);
+    }
+
+    return 0;
+}
+
+/**
+ * Release every buffered packet
+ */
+void preroll_buffer_clear(preroll_buffer_t *buffer) {
+    if (!buffer) {
+        return;
+    }
+
+    preroll_entry_t *entry = buffer->head;
+    while (entry) {
+        preroll_entry_t *next = entry->next;
+        free_entry(buffer, entry);
+        entry = next;
+    }
+
+    buffer->head = NULL;
+    buffer->tail = NULL;
+    buffer->count = 0;
+    buffer->gop_count = 0;
+    buffer->bytes = 0;
+    buffer->newest_video_us = 0;
+}
@@ -0,0 +1,395 @@
+/**
+ * Per-host reconnect coordination
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <strings.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netdb.h>
+
+#include "core/config.h"
+#include "core/logger.h"
+#include "video/reconnect_manager.h"
+#include "video/dns_cache.h"
+
+// Hosts tracked at once; every stream has at most one
+#define RECONNECT_MAX_HOSTS MAX_STREAMS
+
+// A probe result is shared with streams asking within this time
+#define PROBE_RESULT_TTL_MS 2000
+
+// Connect and response timeout of a probe
+#define PROBE_TIMEOUT_MS 2000
+
+// Backoff of an unreachable host, doubled with every failed probe
+#define HOST_BACKOFF_INITIAL_MS 1000
+#define HOST_BACKOFF_MAX_MS 60000
+
+// Once a host is back, its streams reconnect this far apart...
+#define RELEASE_INTERVAL_MS 500
+
+// ...for this long after the first successful probe
+#define RECOVERY_WINDOW_MS 30000
+
+typedef struct {
+    bool used;
+    char host[256];
+    int port;
+    bool rtsp;                  // Probe with an RTSP OPTIONS request, not only a connect
+    int64_t last_used_ms;
+    bool probing;               // A probe is running without the lock
+    bool reachable;             // Result of the last probe
+    int64_t probed_ms;          // When the last probe finished, 0 if never
+    int failures;               // Failed probes since the host was last reachable
+    int64_t retry_ms;           // No stream of the host reconnects before this
+    int64_t recovering_until_ms;
+    int64_t next_release_ms;    // Next free slot while recovering
+} host_entry_t;
+
+static host_entry_t hosts[RECONNECT_MAX_HOSTS];
+static pthread_mutex_t hosts_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t probe_done;
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+
+static void init_probe_cond(void) {
+    pthread_condattr_t cond_attr;
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&probe_done, &cond_attr);
+    pthread_condattr_destroy(&cond_attr);
+}
+
+static int64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * Add up to a quarter at random, so streams waiting on the same host do not
+ * all wake in the same instant
+ */
+static int add_jitter(int delay_ms) {
+    return delay_ms + rand() % (delay_ms / 4 + 1);
+}
+
+int reconnect_manager_host(const char *url, char *host, size_t size, int *port) {
+    static const struct {
+        const char *scheme;
+        int port;
+    } schemes[] = {
+        {"rtsp", 554}, {"rtsps", 322}, {"rtmp", 1935}, {"rtmps", 443},
+        {"http", 80}, {"https", 443}, {"onvif", 80}
+    };
+
+    if (!url || !host || size == 0 || !port) {
+        return -1;
+    }
+
+    const char *sep = strstr(url, "://");
+    if (!sep) {
+        return -1;
+    }
+
+    int default_port = 0;
+    size_t scheme_len = (size_t)(sep - url);
+    for (size_t i = 0; i < sizeof(schemes) / sizeof(schemes[0]); i++) {
+        if (strlen(schemes[i].scheme) == scheme_len && strncasecmp(url, schemes[i].scheme, scheme_len) == 0) {
+            default_port = schemes[i].port;
+            break;
+        }
+    }
+    if (default_port == 0) {
+        return -1;
+    }
+
+    // The authority ends at the path; credentials before the last '@' in it
+    const char *start = sep + 3;
+    const char *end = start + strcspn(start, "/?#");
+    for (const char *p = end; p > start; p--) {
+        if (p[-1] == '@') {
+            start = p;
+            break;
+        }
+    }
+
+    const char *host_end;
+    const char *port_start = NULL;
+    if (*start == '[') {
+        // IPv6 literal
+        start++;
+        host_end = memchr(start, ']', (size_t)(end - start));
+        if (!host_end) {
+            return -1;
+        }
+        if (host_end + 1 < end && host_end[1] == ':') {
+            port_start = host_end + 2;
+        }
+    } else {
+        host_end = memchr(start, ':', (size_t)(end - start));
+        if (host_end) {
+            port_start = host_end + 1;
+        } else {
+            host_end = end;
+        }
+    }
+
+    size_t host_len = (size_t)(host_end - start);
+    if (host_len == 0 || host_len >= size) {
+        return -1;
+    }
+    memcpy(host, start, host_len);
+    host[host_len] = '\0';
+
+    *port = default_port;
+    if (port_start && port_start < end) {
+        char *port_end;
+        long value = strtol(port_start, &port_end, 10);
+        if (port_end != port_start && port_end <= end && value > 0 && value <= 65535) {
+            *port = (int)value;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Find the entry of a host, taking an unused or the least recently used one
+ * if it has none
+ * Must be called with hosts_mutex held.
+ */
+static host_entry_t *get_host_entry(const char *host, int port, int64_t now) {
+    host_entry_t *free_entry = NULL;
+    host_entry_t *oldest = NULL;
+
+    for (int i = 0; i < RECONNECT_MAX_HOSTS; i++) {
+        host_entry_t *entry = &hosts[i];
+        if (!entry->used) {
+            if (!free_entry) {
+                free_entry = entry;
+            }
+            continue;
+        }
+        if (entry->port == port && strcmp(entry->host, host) == 0) {
+            entry->last_used_ms = now;
+            return entry;
+        }
+        if (!entry->probing && (!oldest || entry->last_used_ms < oldest->last_used_ms)) {
+            oldest = entry;
+        }
+    }
+
+    host_entry_t *entry = free_entry ? free_entry : oldest;
+    if (!entry) {
+        return NULL;
+    }
+
+    memset(entry, 0, sizeof(*entry));
+    entry->used = true;
+    snprintf(entry->host, sizeof(entry->host), "%s", host);
+    entry->port = port;
+    entry->reachable = true;
+    entry->last_used_ms = now;
+    return entry;
+}
+
+/**
+ * Look up the entry of a URL's host
+ * Must be called with hosts_mutex held.
+ */
+static host_entry_t *get_url_entry(const char *url, int64_t now) {
+    char host[256];
+    int port;
+    if (reconnect_manager_host(url, host, sizeof(host), &port) != 0) {
+        return NULL;
+    }
+
+    host_entry_t *entry = get_host_entry(host, port, now);
+    if (entry && !entry->probing && entry->probed_ms == 0) {
+        entry->rtsp = strncasecmp(url, "rtsp://", 7) == 0;
+    }
+    return entry;
+}
+
+/**
+ * Connect to a host and, for RTSP, check that it answers an OPTIONS request
+ * Runs without hosts_mutex; a missing stream path only shows when the stream
+ * itself is opened.
+ */
+static bool probe_host(const char *host, int port, bool rtsp) {
+    char port_str[8];
+    snprintf(port_str, sizeof(port_str), "%d", port);
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    // A probe must not wait on a slow DNS server any more than the reconnect itself
+    char addr[64];
+    if (dns_cache_lookup(host, addr, sizeof(addr)) != 0) {
+        return false;
+    }
+    hints.ai_flags = AI_NUMERICHOST;
+
+    struct addrinfo *addrs = NULL;
+    if (getaddrinfo(addr, port_str, &hints, &addrs) != 0 || !addrs) {
+        return false;
+    }
+
+    struct timeval tv;
+    tv.tv_sec = PROBE_TIMEOUT_MS / 1000;
+    tv.tv_usec = (PROBE_TIMEOUT_MS % 1000) * 1000;
+
+    int sock = -1;
+    for (struct addrinfo *ai = addrs; ai; ai = ai->ai_next) {
+        sock = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+        if (sock < 0) {
+            continue;
+        }
+        // SO_SNDTIMEO bounds connect() as well
+        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        if (connect(sock, ai->ai_addr, ai->ai_addrlen) == 0) {
+            break;
+        }
+        close(sock);
+        sock = -1;
+    }
+    freeaddrinfo(addrs);
+
+    if (sock < 0) {
+        return false;
+    }
+
+    bool reachable = true;
+    if (rtsp) {
+        static const char request[] =
+            "OPTIONS * RTSP/1.0\r\n"
+            "CSeq: 1\r\n"
+            "User-Agent: LightNVR\r\n"
+            "\r\n";
+        char response[64] = {0};
+
+        reachable = send(sock, request, sizeof(request) - 1, MSG_NOSIGNAL) > 0 &&
+                    recv(sock, response, sizeof(response) - 1, 0) > 0 &&
+                    strncmp(response, "RTSP/", 5) == 0;
+    }
+
+    close(sock);
+    return reachable;
+}
+
+/**
+ * Record the result of a probe
+ * Must be called with hosts_mutex held.
+ */
+static void record_probe(host_entry_t *entry, bool reachable, int64_t now) {
+    entry->probed_ms = now;
+
+    if (!reachable) {
+        if (entry->failures == 0) {
+            log_warn("Camera host %s:%d is unreachable, backing off reconnects of its streams",
+                     entry->host, entry->port);
+        }
+        if (entry->failures < 16) {
+            entry->failures++;
+        }
+
+        int64_t backoff = (int64_t)HOST_BACKOFF_INITIAL_MS << (entry->failures - 1);
+        if (backoff > HOST_BACKOFF_MAX_MS) {
+            backoff = HOST_BACKOFF_MAX_MS;
+        }
+        entry->retry_ms = now + add_jitter((int)backoff);
+        entry->recovering_until_ms = 0;
+        entry->reachable = false;
+        return;
+    }
+
+    if (entry->failures > 0) {
+        log_info("Camera host %s:%d is reachable again, releasing its streams %d ms apart",
+                 entry->host, entry->port, RELEASE_INTERVAL_MS);
+        entry->recovering_until_ms = now + RECOVERY_WINDOW_MS;
+        entry->next_release_ms = now;
+    }
+    entry->failures = 0;
+    entry->retry_ms = 0;
+    entry->reachable = true;
+}
+
+bool reconnect_manager_probe(const char *url, int *release_ms) {
+    if (release_ms) {
+        *release_ms = 0;
+    }
+
+    pthread_once(&init_once, init_probe_cond);
+    pthread_mutex_lock(&hosts_mutex);
+
+    int64_t now = now_ms();
+    host_entry_t *entry = get_url_entry(url, now);
+    if (!entry) {
+        pthread_mutex_unlock(&hosts_mutex);
+        return true;
+    }
+
+    // Another stream of the host is probing it, use its result
+    if (entry->probing) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += (PROBE_TIMEOUT_MS * 2) / 1000 + 1;
+        while (entry->probing) {
+            if (pthread_cond_timedwait(&probe_done, &hosts_mutex, &deadline) == ETIMEDOUT) {
+                break;
+            }
+        }
+        now = now_ms();
+    } else if (entry->probed_ms == 0 || now - entry->probed_ms >= PROBE_RESULT_TTL_MS) {
+        char host[256];
+        snprintf(host, sizeof(host), "%s", entry->host);
+        int port = entry->port;
+        bool rtsp = entry->rtsp;
+
+        entry->probing = true;
+        pthread_mutex_unlock(&hosts_mutex);
+
+        bool reachable = probe_host(host, port, rtsp);
+
+        pthread_mutex_lock(&hosts_mutex);
+        now = now_ms();
+        entry->probing = false;
+        // The entry is not reused while probing, so it is still this host
+        record_probe(entry, reachable, now);
+        pthread_cond_broadcast(&probe_done);
+    }
+
+    bool reachable = entry->reachable;
+    if (reachable && release_ms && now < entry->recovering_until_ms) {
+        int64_t release = entry->next_release_ms > now ? entry->next_release_ms : now;
+        entry->next_release_ms = release + RELEASE_INTERVAL_MS;
+        *release_ms = (int)(release - now);
+    }
+
+    pthread_mutex_unlock(&hosts_mutex);
+    return reachable;
+}
+
+int reconnect_manager_delay(const char *url, int delay_ms) {
+    pthread_mutex_lock(&hosts_mutex);
+
+    int64_t now = now_ms();
+    host_entry_t *entry = get_url_entry(url, now);
+    if (entry && entry->failures > 0 && entry->retry_ms - now > delay_ms) {
+        delay_ms = (int)(entry->retry_ms - now);
+    }
+
+    pthread_mutex_unlock(&hosts_mutex);
+    return add_jitter(delay_ms);
+}
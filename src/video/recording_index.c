@@ -0,0 +1,563 @@
+#define _FILE_OFFSET_BITS 64
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "core/logger.h"
+#include "core/config.h"
+#include "video/recording_index.h"
+#include "video/recording_thumbnails.h"
+
+#define RECORDING_INDEX_MAGIC "LKFI"
+#define RECORDING_INDEX_VERSION 2
+
+// Largest moov and moof boxes read into memory
+#define MAX_MOOV_SIZE (16 * 1024 * 1024)
+#define MAX_MOOF_SIZE (1024 * 1024)
+
+// Sidecar header, followed by count entries in file order
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t count;
+    uint32_t duration_ms;       // End of the last fragment
+    uint64_t init_size;         // Bytes before the first moof (ftyp and moov)
+    uint64_t file_size;         // Size of the recording when indexed, to spot a stale index
+} recording_index_header_t;
+
+// Sample defaults of a track, from its trex box and overridden by each tfhd
+typedef struct {
+    uint32_t duration;
+    uint32_t flags;
+    bool has_flags;
+} sample_defaults_t;
+
+// sample_is_non_sync_sample in the sample flags
+#define SAMPLE_FLAG_NON_SYNC 0x00010000
+
+/**
+ * Read a big-endian integer
+ */
+static uint64_t read_be(const uint8_t *data, int bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++) {
+        value = (value << 8) | data[i];
+    }
+    return value;
+}
+
+/**
+ * Find the next child box of a type in a box payload
+ *
+ * @param pos Offset to search from, advanced past the box found
+ * @param payload_len Receives the size of the child's payload
+ * @return Child payload, or NULL if there is none
+ */
+static const uint8_t *find_box(const uint8_t *data, size_t len, size_t *pos, const char *type,
+                               size_t *payload_len) {
+    while (*pos + 8 <= len) {
+        const uint8_t *box = data + *pos;
+        uint64_t size = read_be(box, 4);
+        size_t header = 8;
+        if (size == 1) {
+            if (*pos + 16 > len) {
+                return NULL;
+            }
+            size = read_be(box + 8, 8);
+            header = 16;
+        } else if (size == 0) {
+            size = len - *pos;
+        }
+        if (size < header || size > len - *pos) {
+            return NULL;
+        }
+
+        *pos += size;
+        if (memcmp(box + 4, type, 4) == 0) {
+            *payload_len = size - header;
+            return box + header;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Find the track ID and timescale of the video track in a moov payload
+ */
+static int find_video_track(const uint8_t *moov, size_t moov_len, uint32_t *track_id,
+                            uint32_t *timescale) {
+    size_t pos = 0;
+    size_t trak_len;
+    const uint8_t *trak;
+    while ((trak = find_box(moov, moov_len, &pos, "trak", &trak_len)) != NULL) {
+        size_t p = 0, tkhd_len, mdia_len, hdlr_len, mdhd_len;
+        const uint8_t *tkhd = find_box(trak, trak_len, &p, "tkhd", &tkhd_len);
+        p = 0;
+        const uint8_t *mdia = find_box(trak, trak_len, &p, "mdia", &mdia_len);
+        if (!tkhd || !mdia || tkhd_len < 24) {
+            continue;
+        }
+        p = 0;
+        const uint8_t *hdlr = find_box(mdia, mdia_len, &p, "hdlr", &hdlr_len);
+        p = 0;
+        const uint8_t *mdhd = find_box(mdia, mdia_len, &p, "mdhd", &mdhd_len);
+        if (!hdlr || !mdhd || hdlr_len < 12 || mdhd_len < 24 || memcmp(hdlr + 8, "vide", 4) != 0) {
+            continue;
+        }
+
+        // Version 1 boxes have 64-bit creation and modification times
+        *track_id = (uint32_t)read_be(tkhd + (tkhd[0] == 1 ? 20 : 12), 4);
+        *timescale = (uint32_t)read_be(mdhd + (mdhd[0] == 1 ? 20 : 12), 4);
+        return *timescale > 0 ? 0 : -1;
+    }
+    return -1;
+}
+
+/**
+ * Get the sample defaults of a track from the trex box in a moov payload
+ */
+static void find_track_defaults(const uint8_t *moov, size_t moov_len, uint32_t track_id,
+                                sample_defaults_t *defaults) {
+    size_t pos = 0, mvex_len, trex_len;
+    const uint8_t *mvex = find_box(moov, moov_len, &pos, "mvex", &mvex_len);
+    if (!mvex) {
+        return;
+    }
+
+    pos = 0;
+    const uint8_t *trex;
+    while ((trex = find_box(mvex, mvex_len, &pos, "trex", &trex_len)) != NULL) {
+        if (trex_len >= 24 && read_be(trex + 4, 4) == track_id) {
+            defaults->duration = (uint32_t)read_be(trex + 12, 4);
+            defaults->flags = (uint32_t)read_be(trex + 20, 4);
+            defaults->has_flags = true;
+            return;
+        }
+    }
+}
+
+/**
+ * Add up the sample durations of a trun payload
+ *
+ * @param first_flags Receives the flags of the first sample, if the run has samples
+ * @return Duration of the run, in the track timescale
+ */
+static uint64_t run_duration(const uint8_t *trun, size_t trun_len, const sample_defaults_t *defaults,
+                             uint32_t *first_flags) {
+    if (trun_len < 8) {
+        return 0;
+    }
+
+    uint32_t flags = (uint32_t)read_be(trun, 4) & 0xffffff;
+    uint32_t sample_count = (uint32_t)read_be(trun + 4, 4);
+    size_t pos = 8;
+    if (flags & 0x000001) {         // data-offset-present
+        pos += 4;
+    }
+    bool has_first_flags = (flags & 0x000004) != 0;
+    if (has_first_flags) {
+        if (pos + 4 > trun_len) {
+            return 0;
+        }
+        *first_flags = (uint32_t)read_be(trun + pos, 4);
+        pos += 4;
+    }
+
+    size_t sample_size = ((flags & 0x000100) ? 4 : 0) + ((flags & 0x000200) ? 4 : 0) +
+                         ((flags & 0x000400) ? 4 : 0) + ((flags & 0x000800) ? 4 : 0);
+    uint64_t duration = 0;
+    for (uint32_t i = 0; i < sample_count; i++) {
+        if (sample_size > 0 && pos + sample_size > trun_len) {
+            break;
+        }
+        size_t field = pos;
+        if (flags & 0x000100) {     // sample-duration-present
+            duration += read_be(trun + field, 4);
+            field += 4;
+        } else {
+            duration += defaults->duration;
+        }
+        if (flags & 0x000200) {     // sample-size-present
+            field += 4;
+        }
+        if (i == 0 && !has_first_flags) {
+            *first_flags = (flags & 0x000400) ? (uint32_t)read_be(trun + field, 4) : defaults->flags;
+        }
+        pos += sample_size;
+    }
+    return duration;
+}
+
+/**
+ * Get the decode time and duration of a track in a moof payload, and
+ * whether its first sample is a key frame
+ */
+static int fragment_info(const uint8_t *moof, size_t moof_len, uint32_t track_id,
+                         const sample_defaults_t *track_defaults, uint64_t *decode_time,
+                         uint64_t *duration, bool *keyframe) {
+    size_t pos = 0;
+    size_t traf_len;
+    const uint8_t *traf;
+    while ((traf = find_box(moof, moof_len, &pos, "traf", &traf_len)) != NULL) {
+        size_t p = 0, tfhd_len, tfdt_len, trun_len;
+        const uint8_t *tfhd = find_box(traf, traf_len, &p, "tfhd", &tfhd_len);
+        if (!tfhd || tfhd_len < 8 || read_be(tfhd + 4, 4) != track_id) {
+            continue;
+        }
+        p = 0;
+        const uint8_t *tfdt = find_box(traf, traf_len, &p, "tfdt", &tfdt_len);
+        if (!tfdt || tfdt_len < 8) {
+            return -1;
+        }
+        if (tfdt[0] == 1) {
+            if (tfdt_len < 12) {
+                return -1;
+            }
+            *decode_time = read_be(tfdt + 4, 8);
+        } else {
+            *decode_time = read_be(tfdt + 4, 4);
+        }
+
+        // Optional tfhd fields follow the track ID in flag order
+        sample_defaults_t defaults = *track_defaults;
+        uint32_t tfhd_flags = (uint32_t)read_be(tfhd, 4) & 0xffffff;
+        size_t field = 8;
+        if (tfhd_flags & 0x000001) {    // base-data-offset-present
+            field += 8;
+        }
+        if (tfhd_flags & 0x000002) {    // sample-description-index-present
+            field += 4;
+        }
+        if ((tfhd_flags & 0x000008) && field + 4 <= tfhd_len) {
+            defaults.duration = (uint32_t)read_be(tfhd + field, 4);
+            field += 4;
+        }
+        if (tfhd_flags & 0x000010) {    // default-sample-size-present
+            field += 4;
+        }
+        if ((tfhd_flags & 0x000020) && field + 4 <= tfhd_len) {
+            defaults.flags = (uint32_t)read_be(tfhd + field, 4);
+            defaults.has_flags = true;
+        }
+
+        // A fragment cut by frag_duration may start inside a GOP; without any
+        // sample flags every fragment is taken to start on a key frame
+        uint32_t first_flags = defaults.has_flags ? defaults.flags : 0;
+        bool first_run = true;
+        *duration = 0;
+        p = 0;
+        const uint8_t *trun;
+        while ((trun = find_box(traf, traf_len, &p, "trun", &trun_len)) != NULL) {
+            uint32_t run_flags = first_flags;
+            *duration += run_duration(trun, trun_len, &defaults, &run_flags);
+            if (first_run) {
+                first_flags = run_flags;
+                first_run = false;
+            }
+        }
+        *keyframe = (first_flags & SAMPLE_FLAG_NON_SYNC) == 0;
+        return 0;
+    }
+    return -1;
+}
+
+/**
+ * Read a box payload into a new buffer
+ */
+static uint8_t *read_payload(FILE *file, off_t offset, uint64_t len) {
+    uint8_t *data = malloc(len > 0 ? len : 1);
+    if (data && (fseeko(file, offset, SEEK_SET) != 0 || fread(data, 1, len, file) != len)) {
+        free(data);
+        data = NULL;
+    }
+    return data;
+}
+
+/**
+ * Write the sidecar under a temporary name and move it into place
+ */
+static int write_index(const char *mp4_path, const recording_index_header_t *header,
+                       const recording_index_entry_t *entries) {
+    char path[MAX_PATH_LENGTH];
+    char tmp_path[MAX_PATH_LENGTH + 8];
+    if (recording_thumbnails_path(mp4_path, RECORDING_KEYFRAME_INDEX, path, sizeof(path)) != 0) {
+        return -1;
+    }
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    FILE *file = fopen(tmp_path, "wb");
+    if (!file) {
+        log_warn("Failed to create keyframe index %s: %s", tmp_path, strerror(errno));
+        return -1;
+    }
+    bool ok = fwrite(header, sizeof(*header), 1, file) == 1 &&
+              fwrite(entries, sizeof(*entries), header->count, file) == header->count;
+    if (fclose(file) != 0) {
+        ok = false;
+    }
+    if (!ok || rename(tmp_path, path) != 0) {
+        log_warn("Failed to write keyframe index %s", path);
+        unlink(tmp_path);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Build the keyframe index of a finished recording
+ */
+int recording_index_build(const char *mp4_path) {
+    struct stat st;
+    if (!mp4_path || stat(mp4_path, &st) != 0) {
+        return -1;
+    }
+
+    FILE *file = fopen(mp4_path, "rb");
+    if (!file) {
+        log_warn("Failed to open %s for indexing: %s", mp4_path, strerror(errno));
+        return -1;
+    }
+
+    off_t file_size = st.st_size;
+    off_t offset = 0;
+    uint32_t track_id = 0;
+    uint32_t timescale = 0;
+    sample_defaults_t defaults = {0};
+    bool have_track = false;
+    bool have_fragment = false;
+    uint64_t first_decode_time = 0;
+    uint64_t end_time = 0;
+    recording_index_header_t header = {
+        .magic = RECORDING_INDEX_MAGIC,
+        .version = RECORDING_INDEX_VERSION,
+        .file_size = (uint64_t)file_size
+    };
+    recording_index_entry_t *entries = NULL;
+    uint32_t capacity = 0;
+    int result = 0;
+
+    // Only the top-level box headers, the moov and the moofs are read
+    while (offset + 8 <= file_size) {
+        uint8_t box[16];
+        if (fseeko(file, offset, SEEK_SET) != 0 || fread(box, 1, 8, file) != 8) {
+            break;
+        }
+
+        uint64_t box_size = read_be(box, 4);
+        uint64_t header_size = 8;
+        if (box_size == 1) {
+            if (fread(box + 8, 1, 8, file) != 8) {
+                break;
+            }
+            box_size = read_be(box + 8, 8);
+            header_size = 16;
+        } else if (box_size == 0) {
+            box_size = (uint64_t)(file_size - offset);
+        }
+        if (box_size < header_size || box_size > (uint64_t)(file_size - offset)) {
+            break;
+        }
+
+        uint64_t payload_len = box_size - header_size;
+        off_t payload = offset + (off_t)header_size;
+        if (memcmp(box + 4, "moov", 4) == 0 && !have_track && payload_len <= MAX_MOOV_SIZE) {
+            uint8_t *moov = read_payload(file, payload, payload_len);
+            have_track = moov && find_video_track(moov, payload_len, &track_id, &timescale) == 0;
+            if (have_track) {
+                find_track_defaults(moov, payload_len, track_id, &defaults);
+            }
+            free(moov);
+        } else if (memcmp(box + 4, "moof", 4) == 0 && have_track && payload_len <= MAX_MOOF_SIZE) {
+            uint8_t *moof = read_payload(file, payload, payload_len);
+            uint64_t decode_time = 0;
+            uint64_t duration = 0;
+            bool keyframe = false;
+            if (moof && fragment_info(moof, payload_len, track_id, &defaults, &decode_time, &duration,
+                                      &keyframe) == 0) {
+                if (!have_fragment) {
+                    header.init_size = (uint64_t)offset;
+                    first_decode_time = decode_time;
+                    have_fragment = true;
+                }
+                if (decode_time + duration > end_time) {
+                    end_time = decode_time + duration;
+                }
+            }
+            // Only fragments starting on a key frame can be played from
+            if (moof && have_fragment && keyframe) {
+                if (header.count == capacity) {
+                    uint32_t new_capacity = capacity ? capacity * 2 : 256;
+                    recording_index_entry_t *grown = realloc(entries, new_capacity * sizeof(*entries));
+                    if (!grown) {
+                        free(moof);
+                        result = -1;
+                        break;
+                    }
+                    entries = grown;
+                    capacity = new_capacity;
+                }
+                entries[header.count].time_ms =
+                    (int64_t)((decode_time - first_decode_time) * 1000 / timescale);
+                entries[header.count].offset = (uint64_t)offset;
+                header.count++;
+            }
+            free(moof);
+        }
+
+        offset += (off_t)box_size;
+    }
+
+    fclose(file);
+
+    if (have_fragment && end_time > first_decode_time) {
+        uint64_t duration_ms = (end_time - first_decode_time) * 1000 / timescale;
+        header.duration_ms = duration_ms > UINT32_MAX ? UINT32_MAX : (uint32_t)duration_ms;
+    }
+
+    // A single fragment gains nothing over serving the whole file
+    if (result == 0 && header.count > 1) {
+        result = write_index(mp4_path, &header, entries) == 0 ? (int)header.count : -1;
+    } else if (result == 0) {
+        log_debug("Recording %s is not fragmented, no keyframe index", mp4_path);
+        result = -1;
+    }
+
+    free(entries);
+    return result;
+}
+
+/**
+ * Open the sidecar of a recording if it matches the file
+ */
+static int open_index(const char *mp4_path, recording_index_header_t *header) {
+    char path[MAX_PATH_LENGTH];
+    struct stat st;
+    if (recording_thumbnails_path(mp4_path, RECORDING_KEYFRAME_INDEX, path, sizeof(path)) != 0 ||
+        stat(mp4_path, &st) != 0) {
+        return -1;
+    }
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    if (pread(fd, header, sizeof(*header), 0) != (ssize_t)sizeof(*header) ||
+        memcmp(header->magic, RECORDING_INDEX_MAGIC, 4) != 0 ||
+        header->version != RECORDING_INDEX_VERSION ||
+        header->file_size != (uint64_t)st.st_size || header->count == 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * Open the sidecar of a recording, building it first if needed
+ */
+static int open_or_build_index(const char *mp4_path, recording_index_header_t *header) {
+    int fd = open_index(mp4_path, header);
+    if (fd < 0) {
+        // Recordings from before indexing, or changed since
+        if (recording_index_build(mp4_path) < 0) {
+            return -1;
+        }
+        fd = open_index(mp4_path, header);
+    }
+    return fd;
+}
+
+/**
+ * Find the fragment covering a time in a recording
+ */
+int recording_index_find(const char *mp4_path, int64_t time_ms, recording_index_entry_t *entry,
+                         uint64_t *init_size) {
+    if (!mp4_path || !entry) {
+        return -1;
+    }
+
+    recording_index_header_t header;
+    int fd = open_or_build_index(mp4_path, &header);
+    if (fd < 0) {
+        return -1;
+    }
+
+    // Last entry starting at or before time_ms; entry 0 starts at 0
+    uint32_t lo = 0, hi = header.count - 1;
+    int result = 0;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo + 1) / 2;
+        recording_index_entry_t probe;
+        if (pread(fd, &probe, sizeof(probe), (off_t)(sizeof(header) + mid * sizeof(probe))) !=
+            (ssize_t)sizeof(probe)) {
+            result = -1;
+            break;
+        }
+        if (probe.time_ms <= time_ms) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+
+    if (result == 0 &&
+        pread(fd, entry, sizeof(*entry), (off_t)(sizeof(header) + lo * sizeof(*entry))) !=
+        (ssize_t)sizeof(*entry)) {
+        result = -1;
+    }
+    close(fd);
+
+    if (result == 0 && init_size) {
+        *init_size = header.init_size;
+    }
+    return result;
+}
+
+/**
+ * Load the whole keyframe index of a recording
+ */
+int recording_index_load(const char *mp4_path, recording_index_t *index) {
+    if (!mp4_path || !index) {
+        return -1;
+    }
+    memset(index, 0, sizeof(*index));
+
+    recording_index_header_t header;
+    int fd = open_or_build_index(mp4_path, &header);
+    if (fd < 0) {
+        return -1;
+    }
+
+    size_t size = header.count * sizeof(recording_index_entry_t);
+    recording_index_entry_t *entries = malloc(size);
+    if (!entries || pread(fd, entries, size, sizeof(header)) != (ssize_t)size) {
+        free(entries);
+        close(fd);
+        return -1;
+    }
+    close(fd);
+
+    index->entries = entries;
+    index->count = header.count;
+    index->init_size = header.init_size;
+    index->file_size = header.file_size;
+    index->duration_ms = header.duration_ms;
+    return 0;
+}
+
+/**
+ * Free an index loaded by recording_index_load
+ */
+void recording_index_free(recording_index_t *index) {
+    if (index) {
+        free(index->entries);
+        index->entries = NULL;
+        index->count = 0;
+    }
+}
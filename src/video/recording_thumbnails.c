@@ -0,0 +1,436 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/frame.h>
+#include <libswscale/swscale.h>
+
+#include "core/logger.h"
+#include "core/config.h"
+#include "video/recording_thumbnails.h"
+#include "video/detection_scheduler.h"
+#include "video/jpeg_encoder.h"
+#include "storage/storage_latency.h"
+
+// Recordings queued at once; more are picked up when their thumbnail is requested
+#define THUMBNAIL_MAX_QUEUED 256
+
+// Packets read after a seek before giving up on finding a key frame
+#define THUMBNAIL_MAX_PACKETS 600
+
+typedef struct {
+    uint64_t recording_id;
+    char mp4_path[MAX_PATH_LENGTH];
+} thumbnail_job_t;
+
+// Recordings queued or being processed, so repeated requests queue them once
+static uint64_t queued_ids[THUMBNAIL_MAX_QUEUED];
+static pthread_mutex_t queued_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *const kind_suffixes[] = {
+    [RECORDING_THUMBNAIL] = ".thumb.jpg",
+    [RECORDING_SPRITE] = ".sprite.jpg",
+    [RECORDING_SPRITE_VTT] = ".sprite.vtt",
+    [RECORDING_KEYFRAME_INDEX] = ".kfi"
+};
+
+int recording_thumbnails_path(const char *mp4_path, recording_thumbnail_kind_t kind,
+                              char *path, size_t size) {
+    if (!mp4_path || !path || kind < RECORDING_THUMBNAIL || kind > RECORDING_KEYFRAME_INDEX) {
+        return -1;
+    }
+
+    // Replace the extension of the file name, not a dot in a directory
+    size_t base_len = strlen(mp4_path);
+    const char *dot = strrchr(mp4_path, '.');
+    const char *slash = strrchr(mp4_path, '/');
+    if (dot && (!slash || dot > slash)) {
+        base_len = (size_t)(dot - mp4_path);
+    }
+
+    int n = snprintf(path, size, "%.*s%s", (int)base_len, mp4_path, kind_suffixes[kind]);
+    return n < 0 || (size_t)n >= size ? -1 : 0;
+}
+
+/**
+ * Take a recording off the queued list
+ */
+static void unmark_queued(uint64_t recording_id) {
+    pthread_mutex_lock(&queued_mutex);
+    for (int i = 0; i < THUMBNAIL_MAX_QUEUED; i++) {
+        if (queued_ids[i] == recording_id) {
+            queued_ids[i] = 0;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&queued_mutex);
+}
+
+/**
+ * Write a file under a temporary name and move it into place, so readers
+ * never see a partial image
+ */
+static int write_file_atomic(const char *path, const void *data, size_t size) {
+    char tmp_path[MAX_PATH_LENGTH + 8];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    FILE *f = fopen(tmp_path, "wb");
+    if (!f) {
+        log_warn("Failed to create %s: %s", tmp_path, strerror(errno));
+        return -1;
+    }
+    bool ok = fwrite(data, 1, size, f) == size;
+    if (fclose(f) != 0) {
+        ok = false;
+    }
+    if (!ok || rename(tmp_path, path) != 0) {
+        log_warn("Failed to write %s", path);
+        unlink(tmp_path);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Open the video stream of a recording with a decoder that only decodes key frames
+ */
+static int open_video(const char *path, AVFormatContext **fmt_ctx, AVCodecContext **codec_ctx,
+                      int *stream_index) {
+    *fmt_ctx = NULL;
+    *codec_ctx = NULL;
+
+    if (avformat_open_input(fmt_ctx, path, NULL, NULL) != 0) {
+        log_warn("Failed to open recording %s for thumbnails", path);
+        return -1;
+    }
+    if (avformat_find_stream_info(*fmt_ctx, NULL) < 0) {
+        avformat_close_input(fmt_ctx);
+        return -1;
+    }
+
+    const AVCodec *codec = NULL;
+    int index = av_find_best_stream(*fmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, &codec, 0);
+    if (index < 0 || !codec) {
+        avformat_close_input(fmt_ctx);
+        return -1;
+    }
+
+    *codec_ctx = avcodec_alloc_context3(codec);
+    if (!*codec_ctx ||
+        avcodec_parameters_to_context(*codec_ctx, (*fmt_ctx)->streams[index]->codecpar) < 0) {
+        avcodec_free_context(codec_ctx);
+        avformat_close_input(fmt_ctx);
+        return -1;
+    }
+
+    // One thread: this runs beside detection on a shared worker
+    (*codec_ctx)->thread_count = 1;
+    (*codec_ctx)->skip_frame = AVDISCARD_NONKEY;
+    if (avcodec_open2(*codec_ctx, codec, NULL) < 0) {
+        avcodec_free_context(codec_ctx);
+        avformat_close_input(fmt_ctx);
+        return -1;
+    }
+
+    *stream_index = index;
+    return 0;
+}
+
+/**
+ * Decode the key frame at or before a time
+ *
+ * @param seconds Offset from the start of the recording
+ * @return 0 if a frame was decoded, -1 otherwise
+ */
+static int decode_key_frame_at(AVFormatContext *fmt_ctx, AVCodecContext *codec_ctx, int stream_index,
+                               double seconds, AVPacket *pkt, AVFrame *frame) {
+    AVStream *st = fmt_ctx->streams[stream_index];
+    int64_t ts = av_rescale_q((int64_t)(seconds * AV_TIME_BASE), AV_TIME_BASE_Q, st->time_base);
+    if (st->start_time != AV_NOPTS_VALUE) {
+        ts += st->start_time;
+    }
+
+    if (av_seek_frame(fmt_ctx, stream_index, ts, AVSEEK_FLAG_BACKWARD) < 0) {
+        return -1;
+    }
+    avcodec_flush_buffers(codec_ctx);
+
+    for (int packets = 0; packets < THUMBNAIL_MAX_PACKETS; packets++) {
+        if (av_read_frame(fmt_ctx, pkt) < 0) {
+            break;
+        }
+        if (pkt->stream_index != stream_index || !(pkt->flags & AV_PKT_FLAG_KEY)) {
+            av_packet_unref(pkt);
+            continue;
+        }
+
+        int ret = avcodec_send_packet(codec_ctx, pkt);
+        av_packet_unref(pkt);
+        if (ret == 0) {
+            avcodec_send_packet(codec_ctx, NULL);
+            if (avcodec_receive_frame(codec_ctx, frame) == 0) {
+                return 0;
+            }
+        }
+        avcodec_flush_buffers(codec_ctx);
+    }
+    return -1;
+}
+
+/**
+ * Extract the thumbnail from the key frame in the middle of the recording
+ */
+static int generate_thumbnail(AVFormatContext *fmt_ctx, AVCodecContext *codec_ctx, int stream_index,
+                              double duration, AVPacket *pkt, AVFrame *frame, const char *path) {
+    if (decode_key_frame_at(fmt_ctx, codec_ctx, stream_index, duration / 2, pkt, frame) != 0 &&
+        decode_key_frame_at(fmt_ctx, codec_ctx, stream_index, 0, pkt, frame) != 0) {
+        return -1;
+    }
+
+    const uint8_t *jpeg = NULL;
+    size_t jpeg_size = 0;
+    jpeg_encoder_t *encoder = jpeg_encoder_for_thread();
+    int ret = -1;
+    if (encoder && jpeg_encoder_encode_frame(encoder, frame, RECORDING_THUMBNAIL_WIDTH,
+                                             RECORDING_THUMBNAIL_QUALITY, &jpeg, &jpeg_size) == 0) {
+        ret = write_file_atomic(path, jpeg, jpeg_size);
+    }
+    av_frame_unref(frame);
+    return ret;
+}
+
+/**
+ * Format a WebVTT timestamp
+ */
+static void format_vtt_time(double seconds, char *buf, size_t size) {
+    int64_t ms = (int64_t)(seconds * 1000.0 + 0.5);
+    snprintf(buf, size, "%02d:%02d:%02d.%03d", (int)(ms / 3600000), (int)(ms / 60000 % 60),
+             (int)(ms / 1000 % 60), (int)(ms % 1000));
+}
+
+/**
+ * Build the sprite sheet and its WebVTT index
+ * The index refers to the sheet as <id>.jpg, relative to where the API
+ * serves both, see GET /api/recordings/sprite/<id>.vtt.
+ */
+static int generate_sprite(AVFormatContext *fmt_ctx, AVCodecContext *codec_ctx, int stream_index,
+                           double duration, AVPacket *pkt, AVFrame *frame, uint64_t recording_id,
+                           const char *sprite_path, const char *vtt_path) {
+    int width = codec_ctx->width;
+    int height = codec_ctx->height;
+    if (width <= 0 || height <= 0) {
+        return -1;
+    }
+
+    double interval = g_config.thumbnail_sprite_interval;
+    int tiles = (int)(duration / interval) + 1;
+    if (tiles > RECORDING_SPRITE_MAX_TILES) {
+        tiles = RECORDING_SPRITE_MAX_TILES;
+        interval = duration / tiles;
+    }
+    int tile_w = RECORDING_SPRITE_TILE_WIDTH;
+    int tile_h = ((int)((int64_t)tile_w * height / width) + 1) & ~1;
+    int columns = tiles < RECORDING_SPRITE_COLUMNS ? tiles : RECORDING_SPRITE_COLUMNS;
+    int rows = (tiles + columns - 1) / columns;
+
+    AVFrame *sprite = av_frame_alloc();
+    if (!sprite) {
+        return -1;
+    }
+    sprite->format = AV_PIX_FMT_YUV420P;
+    sprite->width = columns * tile_w;
+    sprite->height = rows * tile_h;
+    if (av_frame_get_buffer(sprite, 0) < 0) {
+        av_frame_free(&sprite);
+        return -1;
+    }
+
+    // Black, so tiles without a frame do not show garbage
+    for (int y = 0; y < sprite->height; y++) {
+        memset(sprite->data[0] + y * sprite->linesize[0], 16, sprite->width);
+    }
+    for (int y = 0; y < sprite->height / 2; y++) {
+        memset(sprite->data[1] + y * sprite->linesize[1], 128, sprite->width / 2);
+        memset(sprite->data[2] + y * sprite->linesize[2], 128, sprite->width / 2);
+    }
+
+    size_t vtt_capacity = 16 + (size_t)tiles * 128;
+    char *vtt = malloc(vtt_capacity);
+    if (!vtt) {
+        av_frame_free(&sprite);
+        return -1;
+    }
+    size_t vtt_len = (size_t)snprintf(vtt, vtt_capacity, "WEBVTT\n\n");
+
+    struct SwsContext *sws_ctx = NULL;
+    int decoded = 0;
+    for (int i = 0; i < tiles; i++) {
+        int x = (i % columns) * tile_w;
+        int y = (i / columns) * tile_h;
+
+        if (decode_key_frame_at(fmt_ctx, codec_ctx, stream_index, i * interval, pkt, frame) == 0) {
+            sws_ctx = sws_getCachedContext(sws_ctx, frame->width, frame->height, frame->format,
+                                           tile_w, tile_h, AV_PIX_FMT_YUV420P,
+                                           SWS_BILINEAR, NULL, NULL, NULL);
+            if (sws_ctx) {
+                uint8_t *dst[4] = {
+                    sprite->data[0] + y * sprite->linesize[0] + x,
+                    sprite->data[1] + (y / 2) * sprite->linesize[1] + x / 2,
+                    sprite->data[2] + (y / 2) * sprite->linesize[2] + x / 2,
+                    NULL
+                };
+                sws_scale(sws_ctx, (const uint8_t *const *)frame->data, frame->linesize,
+                          0, frame->height, dst, sprite->linesize);
+                decoded++;
+            }
+            av_frame_unref(frame);
+        }
+
+        char start[16], end[16];
+        double tile_end = (i + 1) * interval < duration ? (i + 1) * interval : duration;
+        format_vtt_time(i * interval, start, sizeof(start));
+        format_vtt_time(tile_end, end, sizeof(end));
+        vtt_len += (size_t)snprintf(vtt + vtt_len, vtt_capacity - vtt_len,
+                                    "%s --> %s\n%llu.jpg#xywh=%d,%d,%d,%d\n\n", start, end,
+                                    (unsigned long long)recording_id, x, y, tile_w, tile_h);
+    }
+    sws_freeContext(sws_ctx);
+
+    int ret = -1;
+    if (decoded > 0) {
+        const uint8_t *jpeg = NULL;
+        size_t jpeg_size = 0;
+        jpeg_encoder_t *encoder = jpeg_encoder_for_thread();
+        if (encoder && jpeg_encoder_encode_frame(encoder, sprite, 0, RECORDING_THUMBNAIL_QUALITY,
+                                                 &jpeg, &jpeg_size) == 0 &&
+            write_file_atomic(sprite_path, jpeg, jpeg_size) == 0) {
+            // The index goes last: its presence means the sheet is complete
+            ret = write_file_atomic(vtt_path, vtt, vtt_len);
+        }
+    }
+
+    free(vtt);
+    av_frame_free(&sprite);
+    return ret;
+}
+
+/**
+ * Generate the missing files of one recording
+ */
+static void process_recording(const thumbnail_job_t *job) {
+    char thumb_path[MAX_PATH_LENGTH];
+    char sprite_path[MAX_PATH_LENGTH];
+    char vtt_path[MAX_PATH_LENGTH];
+    if (recording_thumbnails_path(job->mp4_path, RECORDING_THUMBNAIL, thumb_path, sizeof(thumb_path)) != 0 ||
+        recording_thumbnails_path(job->mp4_path, RECORDING_SPRITE, sprite_path, sizeof(sprite_path)) != 0 ||
+        recording_thumbnails_path(job->mp4_path, RECORDING_SPRITE_VTT, vtt_path, sizeof(vtt_path)) != 0) {
+        return;
+    }
+
+    bool want_thumb = access(thumb_path, F_OK) != 0;
+    bool want_sprite = g_config.thumbnail_sprite_interval > 0 && access(vtt_path, F_OK) != 0;
+    if (!want_thumb && !want_sprite) {
+        return;
+    }
+
+    AVFormatContext *fmt_ctx = NULL;
+    AVCodecContext *codec_ctx = NULL;
+    int stream_index = -1;
+    if (open_video(job->mp4_path, &fmt_ctx, &codec_ctx, &stream_index) != 0) {
+        return;
+    }
+
+    AVPacket *pkt = av_packet_alloc();
+    AVFrame *frame = av_frame_alloc();
+    double duration = fmt_ctx->duration > 0 ? (double)fmt_ctx->duration / AV_TIME_BASE : 0.0;
+
+    if (pkt && frame) {
+        if (want_thumb &&
+            generate_thumbnail(fmt_ctx, codec_ctx, stream_index, duration, pkt, frame, thumb_path) != 0) {
+            log_warn("Failed to generate thumbnail for %s", job->mp4_path);
+        }
+        if (want_sprite && duration > 0 &&
+            generate_sprite(fmt_ctx, codec_ctx, stream_index, duration, pkt, frame,
+                            job->recording_id, sprite_path, vtt_path) != 0) {
+            log_warn("Failed to generate scrub sprite for %s", job->mp4_path);
+        }
+    }
+
+    av_frame_free(&frame);
+    av_packet_free(&pkt);
+    avcodec_free_context(&codec_ctx);
+    avformat_close_input(&fmt_ctx);
+    log_debug("Generated thumbnails for %s", job->mp4_path);
+}
+
+static void thumbnail_job(void *ctx, bool cancelled) {
+    thumbnail_job_t *job = ctx;
+    // Left for when the thumbnail is requested while the disk is slow
+    if (!cancelled && g_config.recording_thumbnails &&
+        storage_latency_level_of_path(job->mp4_path) == STORAGE_LATENCY_OK) {
+        process_recording(job);
+    }
+    unmark_queued(job->recording_id);
+    free(job);
+}
+
+int recording_thumbnails_queue(uint64_t recording_id, const char *mp4_path) {
+    if (!g_config.recording_thumbnails || recording_id == 0 || !mp4_path || !mp4_path[0]) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&queued_mutex);
+    int free_index = -1;
+    for (int i = 0; i < THUMBNAIL_MAX_QUEUED; i++) {
+        if (queued_ids[i] == recording_id) {
+            pthread_mutex_unlock(&queued_mutex);
+            return 0;
+        }
+        if (queued_ids[i] == 0 && free_index < 0) {
+            free_index = i;
+        }
+    }
+    if (free_index < 0) {
+        pthread_mutex_unlock(&queued_mutex);
+        return -1;
+    }
+    queued_ids[free_index] = recording_id;
+    pthread_mutex_unlock(&queued_mutex);
+
+    thumbnail_job_t *job = calloc(1, sizeof(thumbnail_job_t));
+    if (job) {
+        job->recording_id = recording_id;
+        strncpy(job->mp4_path, mp4_path, sizeof(job->mp4_path) - 1);
+        if (detection_scheduler_submit_idle(thumbnail_job, job) == 0) {
+            return 0;
+        }
+        free(job);
+    }
+
+    unmark_queued(recording_id);
+    return -1;
+}
+
+void recording_thumbnails_remove(const char *mp4_path) {
+    if (!mp4_path || !mp4_path[0]) {
+        return;
+    }
+
+    for (int kind = RECORDING_THUMBNAIL; kind <= RECORDING_KEYFRAME_INDEX; kind++) {
+        char path[MAX_PATH_LENGTH];
+        if (recording_thumbnails_path(mp4_path, kind, path, sizeof(path)) == 0 &&
+            unlink(path) != 0 && errno != ENOENT) {
+            log_warn("Failed to delete %s: %s", path, strerror(errno));
+        }
+    }
+}
@@ -0,0 +1,893 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <math.h>
+#include <limits.h>
+#include <pthread.h>
+
+#include <libavformat/avformat.h>
+#include <libswscale/swscale.h>
+
+#include "core/config.h"
+#include "core/logger.h"
+#include "video/hw_decode.h"
+#include "video/stream_transcoding.h"
+#include "video/recording_index.h"
+#include "video/hls_recording.h"
+#include "video/recording_vod.h"
+
+// One segment of a recording
+typedef struct {
+    int64_t start_ms;           // From the start of the recording
+    int64_t end_ms;
+    uint64_t offset;            // Byte range in the file, indexed recordings only
+    uint64_t size;
+    int64_t start_ts;           // Key frame starting it, in the video time base; remuxed only
+    int64_t end_ts;             // Key frame starting the next one, INT64_MAX for the last
+} vod_segment_t;
+
+typedef struct {
+    bool byte_ranges;           // Segments are byte ranges of the file
+    uint64_t init_size;         // Bytes of the initialization section, byte ranges only
+    int64_t origin_ts;          // First key frame in the video time base, remuxed only
+    bool transcoded;            // HEVC video listed as H.264 segments
+    int count;
+    vod_segment_t *segments;
+} vod_layout_t;
+
+// Key frame a segment may start at
+typedef struct {
+    int64_t time_ms;
+    uint64_t offset;
+    int64_t ts;
+} vod_key_t;
+
+// Frames between key frames of transcoded segments; each segment starts with its own
+#define VOD_TRANSCODE_GOP_SIZE 600
+
+// Remuxed resource; index -1 is the initialization section
+typedef struct {
+    uint64_t recording_id;
+    int index;
+    bool transcoded;
+    uint64_t last_used;
+    AVBufferRef *data;
+} vod_cache_entry_t;
+
+static vod_cache_entry_t vod_cache[RECORDING_VOD_CACHE_ENTRIES];
+static size_t vod_cache_bytes = 0;
+static uint64_t vod_cache_clock = 0;
+static pthread_mutex_t vod_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Get a new reference to a cached resource
+ */
+static AVBufferRef *cache_get(uint64_t recording_id, int index, bool transcoded) {
+    AVBufferRef *data = NULL;
+    pthread_mutex_lock(&vod_cache_mutex);
+    for (int i = 0; i < RECORDING_VOD_CACHE_ENTRIES; i++) {
+        vod_cache_entry_t *entry = &vod_cache[i];
+        if (entry->data && entry->recording_id == recording_id && entry->index == index &&
+            entry->transcoded == transcoded) {
+            entry->last_used = ++vod_cache_clock;
+            data = av_buffer_ref(entry->data);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&vod_cache_mutex);
+    return data;
+}
+
+/**
+ * Cache a resource, evicting the least recently used ones to make room
+ */
+static void cache_put(uint64_t recording_id, int index, bool transcoded, const AVBufferRef *data) {
+    if (!data || (size_t)data->size > RECORDING_VOD_CACHE_BYTES) {
+        return;
+    }
+
+    pthread_mutex_lock(&vod_cache_mutex);
+    vod_cache_entry_t *slot = NULL;
+    for (;;) {
+        vod_cache_entry_t *oldest = NULL;
+        slot = NULL;
+        for (int i = 0; i < RECORDING_VOD_CACHE_ENTRIES; i++) {
+            vod_cache_entry_t *entry = &vod_cache[i];
+            if (!entry->data) {
+                slot = entry;
+            } else if (entry->recording_id == recording_id && entry->index == index &&
+                       entry->transcoded == transcoded) {
+                // Made by a concurrent request meanwhile
+                pthread_mutex_unlock(&vod_cache_mutex);
+                return;
+            } else if (!oldest || entry->last_used < oldest->last_used) {
+                oldest = entry;
+            }
+        }
+        if (slot && vod_cache_bytes + (size_t)data->size <= RECORDING_VOD_CACHE_BYTES) {
+            break;
+        }
+        if (!oldest) {
+            break;
+        }
+        vod_cache_bytes -= (size_t)oldest->data->size;
+        av_buffer_unref(&oldest->data);
+    }
+
+    if (slot) {
+        slot->data = av_buffer_ref(data);
+        if (slot->data) {
+            slot->recording_id = recording_id;
+            slot->index = index;
+            slot->transcoded = transcoded;
+            slot->last_used = ++vod_cache_clock;
+            vod_cache_bytes += (size_t)data->size;
+        }
+    }
+    pthread_mutex_unlock(&vod_cache_mutex);
+}
+
+/**
+ * Group key frames into segments of at least RECORDING_VOD_SEGMENT_MS
+ *
+ * @param duration_ms Duration of the recording, 0 if unknown
+ * @param end_offset Size of the file, for the byte range of the last segment
+ */
+static int group_keys(const vod_key_t *keys, int count, int64_t duration_ms, uint64_t end_offset,
+                      vod_layout_t *layout) {
+    layout->segments = calloc(count > 0 ? count : 1, sizeof(vod_segment_t));
+    if (!layout->segments) {
+        return -1;
+    }
+
+    int first = 0;
+    for (int i = 1; i <= count; i++) {
+        if (i < count && keys[i].time_ms - keys[first].time_ms < RECORDING_VOD_SEGMENT_MS) {
+            continue;
+        }
+
+        vod_segment_t *segment = &layout->segments[layout->count++];
+        segment->start_ms = keys[first].time_ms;
+        segment->offset = keys[first].offset;
+        segment->start_ts = keys[first].ts;
+        if (i < count) {
+            segment->end_ms = keys[i].time_ms;
+            segment->size = keys[i].offset - keys[first].offset;
+            segment->end_ts = keys[i].ts;
+        } else {
+            // Without a duration the last segment is taken to be as long as the target
+            segment->end_ms = duration_ms > segment->start_ms ? duration_ms
+                                                               : segment->start_ms + RECORDING_VOD_SEGMENT_MS;
+            segment->size = end_offset > keys[first].offset ? end_offset - keys[first].offset : 0;
+            segment->end_ts = INT64_MAX;
+        }
+        first = i;
+    }
+    return 0;
+}
+
+/**
+ * Lay out a recording from its keyframe index
+ */
+static int load_indexed_layout(const char *file_path, vod_layout_t *layout) {
+    recording_index_t index;
+    if (recording_index_load(file_path, &index) != 0) {
+        return -1;
+    }
+
+    vod_key_t *keys = calloc(index.count, sizeof(vod_key_t));
+    if (!keys) {
+        recording_index_free(&index);
+        return -1;
+    }
+    for (uint32_t i = 0; i < index.count; i++) {
+        keys[i].time_ms = index.entries[i].time_ms;
+        keys[i].offset = index.entries[i].offset;
+    }
+
+    layout->byte_ranges = true;
+    layout->init_size = index.init_size;
+    int ret = group_keys(keys, (int)index.count, index.duration_ms, index.file_size, layout);
+
+    free(keys);
+    recording_index_free(&index);
+    return ret;
+}
+
+/**
+ * Lay out a recording to remux from the key frames in the demuxer's index
+ */
+static int load_remux_layout(AVFormatContext *input, int video_index, vod_layout_t *layout) {
+    AVStream *stream = input->streams[video_index];
+#if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(58, 78, 100)
+    int entry_count = avformat_index_get_entries_count(stream);
+#else
+    int entry_count = stream->nb_index_entries;
+#endif
+    if (entry_count <= 0) {
+        return -1;
+    }
+
+    vod_key_t *keys = calloc(entry_count, sizeof(vod_key_t));
+    if (!keys) {
+        return -1;
+    }
+
+    int count = 0;
+    for (int i = 0; i < entry_count; i++) {
+#if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(58, 78, 100)
+        const AVIndexEntry *entry = avformat_index_get_entry(stream, i);
+#else
+        const AVIndexEntry *entry = &stream->index_entries[i];
+#endif
+        if (!entry || !(entry->flags & AVINDEX_KEYFRAME)) {
+            continue;
+        }
+        if (count == 0) {
+            layout->origin_ts = entry->timestamp;
+        }
+        keys[count].ts = entry->timestamp;
+        keys[count].time_ms = av_rescale_q(entry->timestamp - layout->origin_ts, stream->time_base,
+                                           (AVRational){1, 1000});
+        count++;
+    }
+
+    int64_t duration_ms = 0;
+    if (stream->duration != AV_NOPTS_VALUE && stream->duration > 0) {
+        duration_ms = av_rescale_q(stream->duration, stream->time_base, (AVRational){1, 1000});
+    } else if (input->duration != AV_NOPTS_VALUE && input->duration > 0) {
+        duration_ms = input->duration / 1000;
+    }
+
+    layout->byte_ranges = false;
+    int ret = count > 0 ? group_keys(keys, count, duration_ms, 0, layout) : -1;
+    free(keys);
+    return ret;
+}
+
+/**
+ * Open a recording for remuxing
+ *
+ * @param video_index Receives the index of its video stream
+ */
+static AVFormatContext *open_input(const char *file_path, int *video_index) {
+    AVFormatContext *input = NULL;
+    if (avformat_open_input(&input, file_path, NULL, NULL) < 0) {
+        log_warn("Failed to open recording %s for VOD", file_path);
+        return NULL;
+    }
+
+    *video_index = av_find_best_stream(input, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+    if (*video_index < 0) {
+        log_warn("Recording %s has no video stream", file_path);
+        avformat_close_input(&input);
+        return NULL;
+    }
+    return input;
+}
+
+/**
+ * Lay out a recording made of HLS segments, one VOD segment per file
+ * Segments are numbered from 0 without gaps, so segment n is the file {n}.m4s.
+ */
+static int load_segmented_layout(uint64_t id, vod_layout_t *layout) {
+    recording_segment_t *segments = NULL;
+    int count = get_recording_segments(id, &segments);
+    if (count <= 0) {
+        return -1;
+    }
+
+    layout->segments = calloc(count, sizeof(vod_segment_t));
+    if (!layout->segments) {
+        free(segments);
+        return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        layout->segments[i].start_ms = segments[i].start_ms;
+        layout->segments[i].end_ms = segments[i].start_ms + segments[i].duration_ms;
+        layout->segments[i].size = segments[i].size_bytes;
+    }
+    layout->byte_ranges = false;
+    layout->count = count;
+
+    free(segments);
+    return 0;
+}
+
+/**
+ * Check whether a recording's video is played as H.264 transcoded from HEVC
+ */
+static bool needs_transcode(const AVFormatContext *input, int video_index) {
+    return g_config.transcode_hevc && input->streams[video_index]->codecpar->codec_id == AV_CODEC_ID_HEVC;
+}
+
+/**
+ * Lay out a recording, from its segments or keyframe index if it has them
+ * HEVC recordings asked for as H.264 are cut at the key frames the demuxer
+ * finds, like remuxed ones. On failure the layout is left empty.
+ */
+static int load_layout(uint64_t id, const char *file_path, bool h264, vod_layout_t *layout) {
+    if (hls_recording_is_segmented(file_path)) {
+        return load_segmented_layout(id, layout);
+    }
+
+    int video_index = -1;
+    AVFormatContext *input = NULL;
+    if (h264) {
+        input = open_input(file_path, &video_index);
+        if (!input) {
+            return -1;
+        }
+        if (!needs_transcode(input, video_index)) {
+            avformat_close_input(&input);
+            h264 = false;
+        }
+    }
+
+    if (!h264 && load_indexed_layout(file_path, layout) == 0) {
+        return 0;
+    }
+    free(layout->segments);
+    memset(layout, 0, sizeof(*layout));
+
+    if (!input) {
+        input = open_input(file_path, &video_index);
+        if (!input) {
+            return -1;
+        }
+    }
+    int ret = load_remux_layout(input, video_index, layout);
+    avformat_close_input(&input);
+    if (ret != 0) {
+        free(layout->segments);
+        memset(layout, 0, sizeof(*layout));
+        return ret;
+    }
+    layout->transcoded = h264;
+    return 0;
+}
+
+/**
+ * Close a dynamic buffer and wrap its contents
+ */
+static AVBufferRef *close_dyn_buf(AVIOContext *pb) {
+    uint8_t *buffer = NULL;
+    int size = avio_close_dyn_buf(pb, &buffer);
+    AVBufferRef *data = NULL;
+    if (size > 0 && buffer) {
+        data = av_buffer_create(buffer, size, av_buffer_default_free, NULL, 0);
+    }
+    if (!data) {
+        av_free(buffer);
+    }
+    return data;
+}
+
+// Decoder and H.264 encoder of a recording's HEVC video
+typedef struct {
+    AVCodecContext *decoder;
+    transcode_encoder_t encoder;
+    struct SwsContext *sws_ctx;
+    AVFrame *frame;
+    AVFrame *sw_frame;
+    AVFrame *scaled;
+    AVPacket *pkt;
+} vod_transcoder_t;
+
+static void close_transcoder(vod_transcoder_t *tc) {
+    avcodec_free_context(&tc->decoder);
+    transcode_encoder_close(&tc->encoder);
+    sws_freeContext(tc->sws_ctx);
+    tc->sws_ctx = NULL;
+    av_frame_free(&tc->frame);
+    av_frame_free(&tc->sw_frame);
+    av_frame_free(&tc->scaled);
+    av_packet_free(&tc->pkt);
+}
+
+/**
+ * Open the decoder of a recording's video and an H.264 encoder of the same size
+ * The caller closes the transcoder, also on failure.
+ *
+ * @return 0 on success, RECORDING_VOD_BUSY if no encoder is free, -1 on error
+ */
+static int open_transcoder(vod_transcoder_t *tc, const AVStream *stream) {
+    const AVCodecParameters *codecpar = stream->codecpar;
+    const AVCodec *codec = hw_decode_find_decoder(codecpar->codec_id);
+    tc->decoder = codec ? avcodec_alloc_context3(codec) : NULL;
+    if (!tc->decoder || avcodec_parameters_to_context(tc->decoder, codecpar) < 0) {
+        log_error("Failed to set up VOD transcoding decoder");
+        return -1;
+    }
+    tc->decoder->pkt_timebase = stream->time_base;
+    hw_decode_setup(tc->decoder);
+    if (avcodec_open2(tc->decoder, codec, NULL) < 0) {
+        log_error("Failed to open VOD transcoding decoder %s", codec->name);
+        return -1;
+    }
+
+    AVRational frame_rate = stream->avg_frame_rate.num > 0 ? stream->avg_frame_rate : stream->r_frame_rate;
+    int ret = transcode_encoder_open(&tc->encoder, codecpar->width, codecpar->height, stream->time_base,
+                                     frame_rate, transcode_bit_rate(codecpar->height),
+                                     VOD_TRANSCODE_GOP_SIZE, true);
+    if (ret != 0) {
+        return ret == TRANSCODE_ENCODER_BUSY ? RECORDING_VOD_BUSY : -1;
+    }
+
+    tc->frame = av_frame_alloc();
+    tc->sw_frame = av_frame_alloc();
+    tc->scaled = av_frame_alloc();
+    tc->pkt = av_packet_alloc();
+    if (!tc->frame || !tc->sw_frame || !tc->scaled || !tc->pkt) {
+        return -1;
+    }
+    tc->scaled->format = tc->encoder.sw_format;
+    tc->scaled->width = codecpar->width;
+    tc->scaled->height = codecpar->height;
+    return av_frame_get_buffer(tc->scaled, 0) < 0 ? -1 : 0;
+}
+
+/**
+ * Write the packets the encoder has ready
+ */
+static void write_transcoded(vod_transcoder_t *tc, AVFormatContext *output, int out_index) {
+    AVCodecContext *codec_ctx = tc->encoder.codec_ctx;
+    while (avcodec_receive_packet(codec_ctx, tc->pkt) == 0) {
+        tc->pkt->stream_index = out_index;
+        av_packet_rescale_ts(tc->pkt, codec_ctx->time_base, output->streams[out_index]->time_base);
+        if (av_interleaved_write_frame(output, tc->pkt) < 0) {
+            log_debug("VOD muxer dropped a transcoded packet");
+        }
+        av_packet_unref(tc->pkt);
+    }
+}
+
+/**
+ * Decode a video packet of a segment and encode the frames it yields
+ *
+ * @param pkt Packet, NULL to drain the decoder and the encoder
+ * @param origin_ts First key frame of the recording, the timestamps start there
+ * @param start_ts Key frame starting the segment; frames before it belong to the previous one
+ */
+static void transcode_packet(vod_transcoder_t *tc, const AVPacket *pkt, int64_t origin_ts, int64_t start_ts,
+                             AVFormatContext *output, int out_index) {
+    if (avcodec_send_packet(tc->decoder, pkt) < 0 && pkt) {
+        return;
+    }
+
+    while (avcodec_receive_frame(tc->decoder, tc->frame) == 0) {
+        const AVFrame *src = hw_decode_get_sw_frame(tc->frame, tc->sw_frame);
+        int64_t pts = tc->frame->best_effort_timestamp;
+        if (src && pts != AV_NOPTS_VALUE && pts >= start_ts) {
+            tc->sws_ctx = sws_getCachedContext(tc->sws_ctx, src->width, src->height, src->format,
+                                               tc->scaled->width, tc->scaled->height, tc->scaled->format,
+                                               SWS_BILINEAR, NULL, NULL, NULL);
+            if (tc->sws_ctx && av_frame_make_writable(tc->scaled) >= 0) {
+                sws_scale(tc->sws_ctx, (const uint8_t * const *)src->data, src->linesize, 0, src->height,
+                          tc->scaled->data, tc->scaled->linesize);
+                tc->scaled->pts = pts - origin_ts;
+                if (transcode_encoder_send_frame(&tc->encoder, tc->scaled) == 0) {
+                    write_transcoded(tc, output, out_index);
+                }
+            }
+        }
+        av_frame_unref(tc->frame);
+    }
+
+    if (!pkt) {
+        transcode_encoder_send_frame(&tc->encoder, NULL);
+        write_transcoded(tc, output, out_index);
+    }
+}
+
+/**
+ * Remux the initialization section and optionally one segment of a recording
+ *
+ * Every call uses a new muxer with the same streams, so the initialization
+ * sections are identical. frag_discont makes each segment's fragment carry
+ * the decode time of its first packet, so segments made by separate calls
+ * line up on the timeline of the recording.
+ *
+ * @param index Segment to remux, -1 for the initialization section only
+ * @param transcode Whether to transcode the HEVC video to H.264
+ * @return 0 on success, RECORDING_VOD_BUSY or -1 on failure
+ */
+static int remux(const char *file_path, int index, bool transcode, AVBufferRef **init, AVBufferRef **segment) {
+    int video_index = -1;
+    AVFormatContext *input = open_input(file_path, &video_index);
+    if (!input) {
+        return -1;
+    }
+
+    vod_layout_t layout = {0};
+    vod_transcoder_t tc = {0};
+    AVFormatContext *output = NULL;
+    AVPacket *pkt = NULL;
+    int *stream_map = NULL;
+    int audio_index = -1;
+    int ret = -1;
+
+    if (load_remux_layout(input, video_index, &layout) != 0 || index >= layout.count ||
+        (transcode && !needs_transcode(input, video_index))) {
+        goto cleanup;
+    }
+
+    if (avformat_alloc_output_context2(&output, NULL, "mp4", NULL) < 0 || !output) {
+        log_error("Failed to allocate VOD muxer for %s", file_path);
+        goto cleanup;
+    }
+
+    // The video stream and the first audio stream are copied
+    stream_map = malloc(input->nb_streams * sizeof(int));
+    if (!stream_map) {
+        goto cleanup;
+    }
+    for (unsigned int i = 0; i < input->nb_streams; i++) {
+        stream_map[i] = -1;
+        enum AVMediaType type = input->streams[i]->codecpar->codec_type;
+        if ((int)i != video_index && (type != AVMEDIA_TYPE_AUDIO || audio_index >= 0)) {
+            continue;
+        }
+
+        AVStream *out_stream = avformat_new_stream(output, NULL);
+        if (!out_stream) {
+            log_error("Failed to create VOD stream for %s", file_path);
+            goto cleanup;
+        }
+        if ((int)i == video_index && transcode) {
+            int tc_ret = open_transcoder(&tc, input->streams[i]);
+            if (tc_ret != 0) {
+                ret = tc_ret;
+                goto cleanup;
+            }
+            if (avcodec_parameters_from_context(out_stream->codecpar, tc.encoder.codec_ctx) < 0) {
+                log_error("Failed to create transcoded VOD stream for %s", file_path);
+                goto cleanup;
+            }
+        } else if (avcodec_parameters_copy(out_stream->codecpar, input->streams[i]->codecpar) < 0) {
+            log_error("Failed to create VOD stream for %s", file_path);
+            goto cleanup;
+        }
+        out_stream->codecpar->codec_tag = 0;
+        out_stream->time_base = input->streams[i]->time_base;
+        stream_map[i] = out_stream->index;
+        if (type == AVMEDIA_TYPE_AUDIO) {
+            audio_index = (int)i;
+        }
+    }
+
+    // Timestamps are shifted to start at 0 by hand; the muxer must not shift them per segment
+    AVDictionary *options = NULL;
+    av_dict_set(&options, "movflags", "frag_custom+empty_moov+default_base_moof+frag_discont", 0);
+    av_dict_set(&options, "use_editlist", "0", 0);
+    output->avoid_negative_ts = AVFMT_AVOID_NEG_TS_MAKE_NON_NEGATIVE;
+
+    if (avio_open_dyn_buf(&output->pb) < 0 || avformat_write_header(output, &options) < 0) {
+        log_error("Failed to write VOD initialization section for %s", file_path);
+        av_dict_free(&options);
+        goto cleanup;
+    }
+    av_dict_free(&options);
+
+    *init = close_dyn_buf(output->pb);
+    output->pb = NULL;
+    if (!*init) {
+        goto cleanup;
+    }
+    if (index < 0) {
+        ret = 0;
+        goto cleanup;
+    }
+
+    const vod_segment_t *seg = &layout.segments[index];
+    AVRational video_tb = input->streams[video_index]->time_base;
+    pkt = av_packet_alloc();
+    if (!pkt || avio_open_dyn_buf(&output->pb) < 0) {
+        goto cleanup;
+    }
+    if (av_seek_frame(input, video_index, seg->start_ts, AVSEEK_FLAG_BACKWARD) < 0) {
+        log_warn("Failed to seek to segment %d of %s", index, file_path);
+        goto cleanup;
+    }
+
+    bool video_done = false;
+    bool audio_done = audio_index < 0;
+    while (!video_done || !audio_done) {
+        if (av_read_frame(input, pkt) < 0) {
+            break;
+        }
+
+        AVStream *in_stream = input->streams[pkt->stream_index];
+        int out_index = stream_map[pkt->stream_index];
+        int64_t ts = pkt->dts != AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
+        if (out_index < 0 || ts == AV_NOPTS_VALUE) {
+            av_packet_unref(pkt);
+            continue;
+        }
+
+        // Packets are kept from the segment's key frame up to the next segment's
+        int64_t video_ts = av_rescale_q(ts, in_stream->time_base, video_tb);
+        if (video_ts >= seg->end_ts) {
+            if (pkt->stream_index == video_index) {
+                video_done = true;
+            } else {
+                audio_done = true;
+            }
+            av_packet_unref(pkt);
+            continue;
+        }
+        if (video_ts < seg->start_ts) {
+            av_packet_unref(pkt);
+            continue;
+        }
+
+        if (pkt->stream_index == video_index && tc.decoder) {
+            transcode_packet(&tc, pkt, layout.origin_ts, seg->start_ts, output, out_index);
+            av_packet_unref(pkt);
+            continue;
+        }
+
+        int64_t origin = av_rescale_q(layout.origin_ts, video_tb, in_stream->time_base);
+        if (pkt->pts != AV_NOPTS_VALUE) {
+            pkt->pts -= origin;
+        }
+        if (pkt->dts != AV_NOPTS_VALUE) {
+            pkt->dts -= origin;
+        }
+        pkt->stream_index = out_index;
+        pkt->pos = -1;
+        av_packet_rescale_ts(pkt, in_stream->time_base, output->streams[out_index]->time_base);
+
+        if (av_interleaved_write_frame(output, pkt) < 0) {
+            log_debug("VOD muxer dropped a packet of %s", file_path);
+        }
+        av_packet_unref(pkt);
+    }
+
+    if (tc.decoder) {
+        transcode_packet(&tc, NULL, layout.origin_ts, seg->start_ts, output, stream_map[video_index]);
+    }
+
+    // Drain the interleaving queue, then write everything as one fragment
+    av_interleaved_write_frame(output, NULL);
+    av_write_frame(output, NULL);
+
+    *segment = close_dyn_buf(output->pb);
+    output->pb = NULL;
+    ret = *segment ? 0 : -1;
+
+cleanup:
+    if (ret != 0) {
+        av_buffer_unref(init);
+    }
+    close_transcoder(&tc);
+    if (output) {
+        if (output->pb) {
+            uint8_t *buffer = NULL;
+            avio_close_dyn_buf(output->pb, &buffer);
+            av_free(buffer);
+            output->pb = NULL;
+        }
+        avformat_free_context(output);
+    }
+    av_packet_free(&pkt);
+    free(stream_map);
+    free(layout.segments);
+    avformat_close_input(&input);
+    return ret;
+}
+
+/**
+ * Read a file of a recording made of HLS segments
+ */
+static int read_segmented_resource(const char *file_path, const char *file_name, AVBufferRef **data) {
+    char path[MAX_PATH_LENGTH];
+    if (hls_recording_resource_path(file_path, file_name, path, sizeof(path)) != 0) {
+        return -1;
+    }
+
+    AVIOContext *pb = NULL;
+    if (avio_open(&pb, path, AVIO_FLAG_READ) < 0) {
+        return -1;
+    }
+    int64_t size = avio_size(pb);
+    if (size <= 0 || size > INT_MAX) {
+        avio_closep(&pb);
+        return -1;
+    }
+
+    *data = av_buffer_alloc((int)size);
+    if (!*data || avio_read(pb, (*data)->data, (int)size) != (int)size) {
+        av_buffer_unref(data);
+        avio_closep(&pb);
+        return -1;
+    }
+    avio_closep(&pb);
+    return 0;
+}
+
+/**
+ * Get the initialization section or a segment of a remuxed or transcoded recording
+ */
+int recording_vod_get_resource(uint64_t id, const char *file_path, const char *file_name,
+                               AVBufferRef **data) {
+    if (!file_path || !file_name || !data) {
+        return -1;
+    }
+    *data = NULL;
+
+    bool transcode = strncmp(file_name, RECORDING_VOD_H264_DIR, strlen(RECORDING_VOD_H264_DIR)) == 0;
+    if (transcode) {
+        file_name += strlen(RECORDING_VOD_H264_DIR);
+    }
+
+    // Files of HLS recordings are served as they are; the page cache keeps them
+    if (hls_recording_is_segmented(file_path)) {
+        return transcode ? -1 : read_segmented_resource(file_path, file_name, data);
+    }
+
+    int index = -1;
+    if (strcmp(file_name, RECORDING_VOD_INIT_NAME) != 0) {
+        char suffix[8] = {0};
+        if (sscanf(file_name, "%d.%7s", &index, suffix) != 2 || strcmp(suffix, "m4s") != 0 || index < 0) {
+            return -1;
+        }
+    }
+
+    *data = cache_get(id, index, transcode);
+    if (*data) {
+        return 0;
+    }
+
+    AVBufferRef *init = NULL;
+    AVBufferRef *segment = NULL;
+    int ret = remux(file_path, index, transcode, &init, &segment);
+    if (ret != 0) {
+        return ret;
+    }
+
+    cache_put(id, -1, transcode, init);
+    if (segment) {
+        cache_put(id, index, transcode, segment);
+        *data = segment;
+        av_buffer_unref(&init);
+    } else {
+        *data = init;
+    }
+    return 0;
+}
+
+// Growing text buffer for playlists
+typedef struct {
+    char *text;
+    size_t len;
+    size_t size;
+    bool failed;
+} vod_text_t;
+
+static void text_append(vod_text_t *t, const char *format, ...) {
+    if (t->failed) {
+        return;
+    }
+
+    for (;;) {
+        va_list args;
+        va_start(args, format);
+        int n = vsnprintf(t->text ? t->text + t->len : NULL, t->text ? t->size - t->len : 0, format, args);
+        va_end(args);
+        if (n < 0) {
+            t->failed = true;
+            return;
+        }
+        if (t->text && t->len + (size_t)n < t->size) {
+            t->len += (size_t)n;
+            return;
+        }
+
+        size_t size = t->size ? t->size * 2 : 8192;
+        while (size <= t->len + (size_t)n) {
+            size *= 2;
+        }
+        char *text = realloc(t->text, size);
+        if (!text) {
+            t->failed = true;
+            return;
+        }
+        t->text = text;
+        t->size = size;
+    }
+}
+
+/**
+ * Generate the media playlist of recordings played one after the other
+ */
+char *recording_vod_build_playlist(const recording_vod_item_t *items, int count, size_t *length) {
+    if (!items || count <= 0 || !length) {
+        return NULL;
+    }
+
+    vod_text_t body = {0};
+    double max_duration = 0;
+    int listed = 0;
+
+    for (int i = 0; i < count; i++) {
+        const recording_vod_item_t *item = &items[i];
+        vod_layout_t layout = {0};
+        if (!item->file_path || load_layout(item->id, item->file_path, item->h264, &layout) != 0) {
+            continue;
+        }
+
+        const char *variant = layout.transcoded ? RECORDING_VOD_H264_DIR : "";
+        bool started = false;
+        for (int s = 0; s < layout.count; s++) {
+            const vod_segment_t *segment = &layout.segments[s];
+            if (segment->end_ms <= item->from_ms || (item->to_ms > 0 && segment->start_ms >= item->to_ms)) {
+                continue;
+            }
+
+            if (!started) {
+                // Each recording has its own initialization section and timestamps
+                if (listed > 0) {
+                    text_append(&body, "#EXT-X-DISCONTINUITY\n");
+                }
+                if (layout.byte_ranges) {
+                    text_append(&body, "#EXT-X-MAP:URI=\"/api/recordings/play/%llu\",BYTERANGE=\"%llu@0\"\n",
+                                (unsigned long long)item->id, (unsigned long long)layout.init_size);
+                } else {
+                    text_append(&body, "#EXT-X-MAP:URI=\"/api/recordings/vod/%llu/%s" RECORDING_VOD_INIT_NAME "\"\n",
+                                (unsigned long long)item->id, variant);
+                }
+
+                time_t start = item->start_time + (time_t)(segment->start_ms / 1000);
+                struct tm tm;
+                char date[32];
+                gmtime_r(&start, &tm);
+                strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", &tm);
+                text_append(&body, "#EXT-X-PROGRAM-DATE-TIME:%s.%03dZ\n", date, (int)(segment->start_ms % 1000));
+                started = true;
+                listed++;
+            }
+
+            double duration = (segment->end_ms - segment->start_ms) / 1000.0;
+            if (duration > max_duration) {
+                max_duration = duration;
+            }
+            text_append(&body, "#EXTINF:%.3f,\n", duration);
+            if (layout.byte_ranges) {
+                text_append(&body, "#EXT-X-BYTERANGE:%llu@%llu\n/api/recordings/play/%llu\n",
+                            (unsigned long long)segment->size, (unsigned long long)segment->offset,
+                            (unsigned long long)item->id);
+            } else {
+                text_append(&body, "/api/recordings/vod/%llu/%s%d.m4s\n", (unsigned long long)item->id, variant, s);
+            }
+        }
+        free(layout.segments);
+    }
+
+    if (listed == 0 || body.failed) {
+        free(body.text);
+        return NULL;
+    }
+
+    vod_text_t playlist = {0};
+    text_append(&playlist,
+                "#EXTM3U\n"
+                "#EXT-X-VERSION:7\n"
+                "#EXT-X-TARGETDURATION:%d\n"
+                "#EXT-X-MEDIA-SEQUENCE:0\n"
+                "#EXT-X-PLAYLIST-TYPE:VOD\n"
+                "#EXT-X-INDEPENDENT-SEGMENTS\n"
+                "%s"
+                "#EXT-X-ENDLIST\n",
+                (int)ceil(max_duration), body.text);
+    free(body.text);
+
+    if (playlist.failed) {
+        free(playlist.text);
+        return NULL;
+    }
+    *length = playlist.len;
+    return playlist.text;
+}
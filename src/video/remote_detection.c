@@ -0,0 +1,658 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+
+#include "core/logger.h"
+#include "core/config.h"
+#include "video/jpeg_encoder.h"
+#include "video/remote_detection.h"
+#include "video/thread_utils.h"
+
+/*
+ * Wire format, all integers big-endian, floats as IEEE 754 single bits:
+ *
+ *   header:  u32 magic 'LNVI', u8 version, u8 type, u16 flags (0),
+ *            u32 request id, u32 payload length
+ *   DETECT:  u16 width, u16 height, u8 channels, u8 encoding, u16 reserved,
+ *            f32 threshold, image (rest of the payload)
+ *   RESULT:  u16 count, u16 reserved, then per detection
+ *            f32 confidence, f32 x, f32 y, f32 width, f32 height,
+ *            u8 label length, label
+ *   ERROR:   message (rest of the payload)
+ *
+ * The client sends DETECT frames, the server answers each with a RESULT or
+ * ERROR carrying the same request id, in any order.
+ */
+#define REMOTE_MAGIC 0x4C4E5649u
+#define REMOTE_VERSION 1
+#define REMOTE_HEADER_SIZE 16
+#define REMOTE_DETECT_META_SIZE 12
+
+#define REMOTE_MSG_DETECT 1
+#define REMOTE_MSG_RESULT 2
+#define REMOTE_MSG_ERROR 3
+
+#define REMOTE_ENCODING_RAW 0
+#define REMOTE_ENCODING_JPEG 1
+
+// Largest response accepted; a full detection list is a few KB
+#define REMOTE_MAX_RESPONSE (256 * 1024)
+
+// How long to wait before reconnecting to a server that refused us
+#define REMOTE_RECONNECT_DELAY_MS 1000
+
+// Request waiting for its response, on the stack of the detecting thread
+typedef struct remote_request {
+    struct remote_request *next;
+    uint32_t id;
+    bool done;
+    int status;
+    detection_result_t *result;
+} remote_request_t;
+
+struct remote_connection {
+    struct remote_connection *next;     // Next connection in the registry
+    char address[MAX_PATH_LENGTH];      // Server address
+    int refs;                           // Models using the connection (registry mutex)
+
+    pthread_mutex_t write_mutex;        // Serializes frames on the socket; taken before mutex
+    pthread_mutex_t mutex;              // Guards the fields below
+    pthread_cond_t cond;                // Broadcast when requests complete
+    int fd;                             // Socket, -1 when not connected
+    bool broken;                        // Reader stopped, the socket must be reopened
+    bool reader_running;
+    pthread_t reader;
+    remote_request_t *pending;          // Requests sent and not answered
+    uint32_t next_id;
+    int64_t retry_after_ms;             // Earliest time of the next connection attempt
+};
+
+static remote_connection_t *connections = NULL;
+static pthread_mutex_t connections_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static int64_t monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void put_u16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)v;
+}
+
+static void put_u32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+static uint16_t get_u16(const uint8_t *p) {
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static uint32_t get_u32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static float get_f32(const uint8_t *p) {
+    uint32_t bits = get_u32(p);
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static void put_f32(uint8_t *p, float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    put_u32(p, bits);
+}
+
+const char *remote_detection_address(const char *model_path) {
+    if (!model_path) {
+        return NULL;
+    }
+
+    const char *address = strstr(model_path, "tcp://");
+    if (!address) {
+        address = strstr(model_path, "unix://");
+    }
+    return address;
+}
+
+/**
+ * Connect to a TCP address, giving up after timeout_ms
+ */
+static int connect_tcp(const char *hostport, int timeout_ms) {
+    char host[256];
+    const char *colon = strrchr(hostport, ':');
+    if (!colon || colon == hostport || (size_t)(colon - hostport) >= sizeof(host) || !colon[1]) {
+        log_error("Remote detection: invalid TCP address %s (expected host:port)", hostport);
+        return -1;
+    }
+    memcpy(host, hostport, colon - hostport);
+    host[colon - hostport] = '\0';
+
+    // Bracketed IPv6 literal
+    char *name = host;
+    size_t host_len = strlen(host);
+    if (host[0] == '[' && host[host_len - 1] == ']') {
+        host[host_len - 1] = '\0';
+        name = host + 1;
+    }
+
+    struct addrinfo hints = {0};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    struct addrinfo *addrs = NULL;
+    int gai = getaddrinfo(name, colon + 1, &hints, &addrs);
+    if (gai != 0) {
+        log_error("Remote detection: cannot resolve %s: %s", name, gai_strerror(gai));
+        return -1;
+    }
+
+    int fd = -1;
+    for (struct addrinfo *ai = addrs; ai && fd < 0; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC | SOCK_NONBLOCK, ai->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+
+        int ret = connect(fd, ai->ai_addr, ai->ai_addrlen);
+        if (ret != 0 && errno == EINPROGRESS) {
+            struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+            int error = 0;
+            socklen_t len = sizeof(error);
+            if (poll(&pfd, 1, timeout_ms) == 1 &&
+                getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len) == 0 && error == 0) {
+                ret = 0;
+            } else {
+                errno = error ? error : ETIMEDOUT;
+            }
+        }
+
+        if (ret != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(addrs);
+
+    if (fd < 0) {
+        log_error("Remote detection: cannot connect to %s: %s", hostport, strerror(errno));
+        return -1;
+    }
+
+    // Back to blocking; small frames must not wait for Nagle
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &one, sizeof(one));
+    return fd;
+}
+
+/**
+ * Connect to a Unix socket path
+ */
+static int connect_unix(const char *path) {
+    struct sockaddr_un addr = {0};
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        log_error("Remote detection: socket path too long: %s", path);
+        return -1;
+    }
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        log_error("Remote detection: failed to create socket: %s", strerror(errno));
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        log_error("Remote detection: cannot connect to %s: %s", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int read_full(int fd, uint8_t *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = recv(fd, buf, len, 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        buf += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static int send_full(int fd, struct iovec *iov, int iovcnt) {
+    while (iovcnt > 0) {
+        struct msghdr msg = {0};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = iovcnt;
+
+        ssize_t n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return -1;
+        }
+
+        // Skip what went out
+        while (iovcnt > 0 && (size_t)n >= iov->iov_len) {
+            n -= (ssize_t)iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (uint8_t *)iov->iov_base + n;
+            iov->iov_len -= (size_t)n;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Decode a RESULT payload into a detection result
+ */
+static int parse_result(const uint8_t *payload, uint32_t len, detection_result_t *result) {
+    if (len < 4) {
+        return -1;
+    }
+
+    int count = get_u16(payload);
+    uint32_t pos = 4;
+    result->count = 0;
+
+    for (int i = 0; i < count; i++) {
+        if (pos + 21 > len) {
+            return -1;
+        }
+        const uint8_t *p = payload + pos;
+        uint8_t label_len = p[20];
+        if (pos + 21 + label_len > len) {
+            return -1;
+        }
+        pos += 21 + label_len;
+
+        if (result->count >= MAX_DETECTIONS) {
+            continue;
+        }
+
+        detection_t *det = &result->detections[result->count++];
+        det->confidence = get_f32(p);
+        det->x = get_f32(p + 4);
+        det->y = get_f32(p + 8);
+        det->width = get_f32(p + 12);
+        det->height = get_f32(p + 16);
+
+        size_t copy = label_len < MAX_LABEL_LENGTH - 1 ? label_len : MAX_LABEL_LENGTH - 1;
+        memcpy(det->label, p + 21, copy);
+        det->label[copy] = '\0';
+    }
+
+    return 0;
+}
+
+/**
+ * Reader thread: matches responses to the requests waiting for them until
+ * the connection fails, then fails every request still pending
+ */
+static void *remote_reader_thread(void *arg) {
+    remote_connection_t *conn = (remote_connection_t *)arg;
+    thread_set_identity(THREAD_CLASS_DETECTION, "det-remote", NULL);
+
+    pthread_mutex_lock(&conn->mutex);
+    int fd = conn->fd;
+    pthread_mutex_unlock(&conn->mutex);
+
+    uint8_t header[REMOTE_HEADER_SIZE];
+    uint8_t *payload = NULL;
+    size_t capacity = 0;
+
+    while (read_full(fd, header, sizeof(header)) == 0) {
+        uint32_t magic = get_u32(header);
+        uint8_t version = header[4];
+        uint8_t type = header[5];
+        uint32_t id = get_u32(header + 8);
+        uint32_t len = get_u32(header + 12);
+
+        if (magic != REMOTE_MAGIC || version != REMOTE_VERSION || len > REMOTE_MAX_RESPONSE) {
+            log_error("Remote detection: protocol error from %s (magic %08x, version %u, length %u)",
+                      conn->address, magic, version, len);
+            break;
+        }
+
+        if (len > capacity) {
+            uint8_t *grown = realloc(payload, len);
+            if (!grown) {
+                log_error("Remote detection: failed to allocate %u byte response", len);
+                break;
+            }
+            payload = grown;
+            capacity = len;
+        }
+        if (len > 0 && read_full(fd, payload, len) != 0) {
+            break;
+        }
+
+        pthread_mutex_lock(&conn->mutex);
+        remote_request_t **link = &conn->pending;
+        while (*link && (*link)->id != id) {
+            link = &(*link)->next;
+        }
+
+        // Requests that timed out are gone; their late answers are dropped
+        remote_request_t *req = *link;
+        if (req) {
+            *link = req->next;
+            if (type == REMOTE_MSG_RESULT) {
+                req->status = parse_result(payload, len, req->result);
+                if (req->status != 0) {
+                    log_error("Remote detection: malformed result from %s", conn->address);
+                }
+            } else {
+                log_error("Remote detection: %s failed request %u: %.*s", conn->address, id,
+                          type == REMOTE_MSG_ERROR ? (int)len : 0, (const char *)payload);
+                req->status = -1;
+            }
+            req->done = true;
+            pthread_cond_broadcast(&conn->cond);
+        }
+        pthread_mutex_unlock(&conn->mutex);
+    }
+
+    free(payload);
+
+    pthread_mutex_lock(&conn->mutex);
+    conn->broken = true;
+    while (conn->pending) {
+        remote_request_t *req = conn->pending;
+        conn->pending = req->next;
+        req->status = -1;
+        req->done = true;
+    }
+    pthread_cond_broadcast(&conn->cond);
+    pthread_mutex_unlock(&conn->mutex);
+
+    log_warn("Remote detection: connection to %s closed", conn->address);
+    return NULL;
+}
+
+/**
+ * Close the socket and collect the reader
+ * Must be called with write_mutex and mutex held.
+ */
+static void disconnect_locked(remote_connection_t *conn) {
+    if (conn->fd >= 0) {
+        shutdown(conn->fd, SHUT_RDWR);
+    }
+    if (conn->reader_running) {
+        // The reader takes the mutex on its way out
+        pthread_mutex_unlock(&conn->mutex);
+        pthread_join(conn->reader, NULL);
+        pthread_mutex_lock(&conn->mutex);
+        conn->reader_running = false;
+    }
+    if (conn->fd >= 0) {
+        close(conn->fd);
+        conn->fd = -1;
+    }
+    conn->broken = false;
+}
+
+/**
+ * Make sure the connection is up, reopening it if it failed
+ * Must be called with write_mutex held.
+ */
+static int ensure_connected(remote_connection_t *conn, int timeout_ms) {
+    pthread_mutex_lock(&conn->mutex);
+    if (conn->fd >= 0 && !conn->broken) {
+        pthread_mutex_unlock(&conn->mutex);
+        return 0;
+    }
+
+    disconnect_locked(conn);
+
+    if (monotonic_ms() < conn->retry_after_ms) {
+        pthread_mutex_unlock(&conn->mutex);
+        return -1;
+    }
+
+    int fd;
+    if (strncmp(conn->address, "unix://", 7) == 0) {
+        fd = connect_unix(conn->address + 7);
+    } else {
+        fd = connect_tcp(conn->address + 6, timeout_ms);
+    }
+
+    if (fd < 0) {
+        conn->retry_after_ms = monotonic_ms() + REMOTE_RECONNECT_DELAY_MS;
+        pthread_mutex_unlock(&conn->mutex);
+        return -1;
+    }
+
+    conn->fd = fd;
+    if (pthread_create(&conn->reader, NULL, remote_reader_thread, conn) != 0) {
+        log_error("Remote detection: failed to start reader for %s", conn->address);
+        close(fd);
+        conn->fd = -1;
+        pthread_mutex_unlock(&conn->mutex);
+        return -1;
+    }
+    conn->reader_running = true;
+    pthread_mutex_unlock(&conn->mutex);
+
+    log_info("Remote detection: connected to %s", conn->address);
+    return 0;
+}
+
+remote_connection_t *remote_detection_open(const char *address) {
+    if (!address || (strncmp(address, "tcp://", 6) != 0 && strncmp(address, "unix://", 7) != 0)) {
+        log_error("Remote detection: unsupported address %s", address ? address : "(null)");
+        return NULL;
+    }
+
+    pthread_mutex_lock(&connections_mutex);
+    for (remote_connection_t *conn = connections; conn; conn = conn->next) {
+        if (strcmp(conn->address, address) == 0) {
+            conn->refs++;
+            pthread_mutex_unlock(&connections_mutex);
+            return conn;
+        }
+    }
+
+    remote_connection_t *conn = calloc(1, sizeof(remote_connection_t));
+    if (!conn) {
+        pthread_mutex_unlock(&connections_mutex);
+        log_error("Remote detection: failed to allocate connection");
+        return NULL;
+    }
+
+    strncpy(conn->address, address, MAX_PATH_LENGTH - 1);
+    conn->address[MAX_PATH_LENGTH - 1] = '\0';
+    conn->refs = 1;
+    conn->fd = -1;
+    conn->next_id = 1;
+    pthread_mutex_init(&conn->write_mutex, NULL);
+    pthread_mutex_init(&conn->mutex, NULL);
+    pthread_cond_init(&conn->cond, NULL);
+
+    conn->next = connections;
+    connections = conn;
+    pthread_mutex_unlock(&connections_mutex);
+
+    log_info("Remote detection: using inference server %s", address);
+    return conn;
+}
+
+void remote_detection_close(remote_connection_t *conn) {
+    if (!conn) {
+        return;
+    }
+
+    pthread_mutex_lock(&connections_mutex);
+    if (--conn->refs > 0) {
+        pthread_mutex_unlock(&connections_mutex);
+        return;
+    }
+
+    for (remote_connection_t **link = &connections; *link; link = &(*link)->next) {
+        if (*link == conn) {
+            *link = conn->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&connections_mutex);
+
+    pthread_mutex_lock(&conn->write_mutex);
+    pthread_mutex_lock(&conn->mutex);
+    disconnect_locked(conn);
+    pthread_mutex_unlock(&conn->mutex);
+    pthread_mutex_unlock(&conn->write_mutex);
+
+    pthread_cond_destroy(&conn->cond);
+    pthread_mutex_destroy(&conn->mutex);
+    pthread_mutex_destroy(&conn->write_mutex);
+    log_info("Remote detection: closed connection to %s", conn->address);
+    free(conn);
+}
+
+int remote_detection_detect(remote_connection_t *conn, const unsigned char *frame_data,
+                            int width, int height, int channels, float threshold,
+                            detection_result_t *result) {
+    if (!conn || !frame_data || !result || width <= 0 || width > 65535 ||
+        height <= 0 || height > 65535 || (channels != 1 && channels != 3 && channels != 4)) {
+        log_error("Invalid parameters for remote_detection_detect");
+        return -1;
+    }
+    memset(result, 0, sizeof(detection_result_t));
+
+    int timeout_ms = g_config.remote_detection_timeout_ms > 0 ? g_config.remote_detection_timeout_ms : 2000;
+
+    // Compress before taking the connection, so streams encode in parallel
+    const uint8_t *image = frame_data;
+    size_t image_size = (size_t)width * height * channels;
+    uint8_t encoding = REMOTE_ENCODING_RAW;
+
+    jpeg_encoder_t *encoder = jpeg_encoder_for_thread();
+    const uint8_t *jpeg = NULL;
+    size_t jpeg_size = 0;
+    if (encoder && jpeg_encoder_encode(encoder, frame_data, width, height, channels,
+                                       g_config.remote_detection_jpeg_quality, &jpeg, &jpeg_size) == 0) {
+        image = jpeg;
+        image_size = jpeg_size;
+        encoding = REMOTE_ENCODING_JPEG;
+    } else {
+        log_warn("Remote detection: JPEG encoding failed, sending the raw frame");
+    }
+
+    if (image_size > UINT32_MAX - REMOTE_DETECT_META_SIZE) {
+        log_error("Remote detection: frame too large (%zu bytes)", image_size);
+        return -1;
+    }
+
+    remote_request_t req = {
+        .next = NULL,
+        .done = false,
+        .status = -1,
+        .result = result
+    };
+
+    pthread_mutex_lock(&conn->write_mutex);
+    if (ensure_connected(conn, timeout_ms) != 0) {
+        pthread_mutex_unlock(&conn->write_mutex);
+        return -1;
+    }
+
+    pthread_mutex_lock(&conn->mutex);
+    req.id = conn->next_id++;
+    req.next = conn->pending;
+    conn->pending = &req;
+    int fd = conn->fd;
+    pthread_mutex_unlock(&conn->mutex);
+
+    uint8_t head[REMOTE_HEADER_SIZE + REMOTE_DETECT_META_SIZE];
+    put_u32(head, REMOTE_MAGIC);
+    head[4] = REMOTE_VERSION;
+    head[5] = REMOTE_MSG_DETECT;
+    put_u16(head + 6, 0);
+    put_u32(head + 8, req.id);
+    put_u32(head + 12, (uint32_t)(REMOTE_DETECT_META_SIZE + image_size));
+
+    uint8_t *meta = head + REMOTE_HEADER_SIZE;
+    put_u16(meta, (uint16_t)width);
+    put_u16(meta + 2, (uint16_t)height);
+    meta[4] = (uint8_t)channels;
+    meta[5] = encoding;
+    put_u16(meta + 6, 0);
+    put_f32(meta + 8, threshold);
+
+    struct iovec iov[2] = {
+        { .iov_base = head, .iov_len = sizeof(head) },
+        { .iov_base = (void *)image, .iov_len = image_size }
+    };
+    if (send_full(fd, iov, 2) != 0) {
+        log_error("Remote detection: failed to send frame to %s: %s", conn->address, strerror(errno));
+        // The reader sees the shutdown and fails this and every other pending request
+        shutdown(fd, SHUT_RDWR);
+    }
+    pthread_mutex_unlock(&conn->write_mutex);
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&conn->mutex);
+    while (!req.done) {
+        if (pthread_cond_timedwait(&conn->cond, &conn->mutex, &deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+
+    if (!req.done) {
+        // Withdraw the request; a late answer finds nothing to complete
+        for (remote_request_t **link = &conn->pending; *link; link = &(*link)->next) {
+            if (*link == &req) {
+                *link = req.next;
+                break;
+            }
+        }
+        log_warn("Remote detection: request %u to %s timed out after %d ms", req.id, conn->address, timeout_ms);
+        memset(result, 0, sizeof(detection_result_t));
+    }
+    pthread_mutex_unlock(&conn->mutex);
+
+    return req.done ? req.status : -1;
+}
@@ -0,0 +1,338 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+
+#include <libavutil/buffer.h>
+#include <libavutil/frame.h>
+
+#include "core/logger.h"
+#include "core/config.h"
+#include "video/snapshot_cache.h"
+#include "video/jpeg_encoder.h"
+#include "video/hw_decode.h"
+
+// Encoded image of one size and quality
+typedef struct {
+    int width;                         // Requested width, 0 for the frame's own
+    int quality;
+    uint64_t frame_seq;                // Frame it was encoded from, 0 if unused
+    time_t frame_time;                 // When that frame was taken
+    int64_t encoded_ms;
+    int64_t used_ms;                   // Last request, to pick the variant to replace
+    AVBufferRef *jpeg;
+} snapshot_variant_t;
+
+// Cached stream
+typedef struct {
+    char stream_name[MAX_STREAM_NAME];
+    AVFrame *frame;                    // Newest frame in system memory, NULL if none yet
+    uint64_t frame_seq;                // Frames taken so far
+    int64_t frame_ms;                  // When the newest frame was taken
+    time_t frame_time;
+    int64_t requested_ms;              // Last snapshot request
+    int fast_interval_ms;              // Shorter interval asked for, while fast_requested_ms is recent
+    int64_t fast_requested_ms;
+    pthread_mutex_t encode_mutex;      // Serializes encoding; guards the variants
+    snapshot_variant_t variants[SNAPSHOT_CACHE_VARIANTS];
+    int refs;                          // Requests using it (entries mutex)
+    bool closed;                       // Removed from the table, freed by the last request
+} snapshot_entry_t;
+
+// Frame, frame_seq, frame_ms, frame_time and the request times are guarded by the entries mutex
+static snapshot_entry_t *entries[MAX_STREAMS];
+static pthread_mutex_t entries_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static int64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void destroy_entry(snapshot_entry_t *entry) {
+    av_frame_free(&entry->frame);
+    for (int i = 0; i < SNAPSHOT_CACHE_VARIANTS; i++) {
+        av_buffer_unref(&entry->variants[i].jpeg);
+    }
+    pthread_mutex_destroy(&entry->encode_mutex);
+    free(entry);
+}
+
+/**
+ * Find the entry of a stream
+ * Must be called with the entries mutex held.
+ */
+static snapshot_entry_t *find_entry(const char *stream_name) {
+    for (int i = 0; i < MAX_STREAMS; i++) {
+        if (entries[i] && strcmp(entries[i]->stream_name, stream_name) == 0) {
+            return entries[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Interval between frames of an entry
+ * A shorter one lapses once it has not been asked for for a default interval.
+ * Must be called with the entries mutex held.
+ */
+static int entry_interval(const snapshot_entry_t *entry, int64_t now) {
+    if (entry->fast_interval_ms > 0 && now - entry->fast_requested_ms < SNAPSHOT_CACHE_INTERVAL_MS) {
+        return entry->fast_interval_ms;
+    }
+    return SNAPSHOT_CACHE_INTERVAL_MS;
+}
+
+/**
+ * Whether an entry wants a new frame
+ * Must be called with the entries mutex held.
+ */
+static bool entry_wants_frame(const snapshot_entry_t *entry, int64_t now) {
+    return now - entry->requested_ms < SNAPSHOT_CACHE_DEMAND_MS &&
+           (!entry->frame || now - entry->frame_ms >= entry_interval(entry, now));
+}
+
+/**
+ * Take a reference to the entry of a stream, created on first use
+ */
+static snapshot_entry_t *get_entry(const char *stream_name) {
+    pthread_mutex_lock(&entries_mutex);
+
+    snapshot_entry_t *entry = find_entry(stream_name);
+    if (!entry) {
+        for (int i = 0; i < MAX_STREAMS; i++) {
+            if (!entries[i]) {
+                entry = calloc(1, sizeof(snapshot_entry_t));
+                if (entry) {
+                    strncpy(entry->stream_name, stream_name, MAX_STREAM_NAME - 1);
+                    pthread_mutex_init(&entry->encode_mutex, NULL);
+                    entries[i] = entry;
+                }
+                break;
+            }
+        }
+    }
+    if (entry) {
+        entry->refs++;
+    }
+
+    pthread_mutex_unlock(&entries_mutex);
+    return entry;
+}
+
+/**
+ * Drop a reference taken by get_entry
+ */
+static void put_entry(snapshot_entry_t *entry) {
+    pthread_mutex_lock(&entries_mutex);
+    if (--entry->refs == 0 && entry->closed) {
+        destroy_entry(entry);
+    }
+    pthread_mutex_unlock(&entries_mutex);
+}
+
+/**
+ * Take an entry out of the table; it is freed once no request uses it
+ * Must be called with the entries mutex held.
+ */
+static void remove_entry(int index) {
+    snapshot_entry_t *entry = entries[index];
+    entries[index] = NULL;
+    entry->closed = true;
+    if (entry->refs == 0) {
+        destroy_entry(entry);
+    }
+}
+
+bool snapshot_cache_wants_frame(const char *stream_name) {
+    if (!stream_name) {
+        return false;
+    }
+
+    pthread_mutex_lock(&entries_mutex);
+    snapshot_entry_t *entry = find_entry(stream_name);
+    bool wanted = entry && entry_wants_frame(entry, now_ms());
+    pthread_mutex_unlock(&entries_mutex);
+    return wanted;
+}
+
+void snapshot_cache_offer(const char *stream_name, const AVFrame *frame) {
+    if (!frame || frame->width <= 0 || frame->height <= 0 || !snapshot_cache_wants_frame(stream_name)) {
+        return;
+    }
+
+    // Hardware frames are downloaded once here rather than pinning a decoder surface
+    AVFrame *copy = av_frame_alloc();
+    if (!copy) {
+        return;
+    }
+    if (frame->hw_frames_ctx) {
+        if (hw_decode_get_sw_frame(frame, copy) != copy) {
+            av_frame_free(&copy);
+            return;
+        }
+    } else if (av_frame_ref(copy, frame) < 0) {
+        av_frame_free(&copy);
+        return;
+    }
+
+    pthread_mutex_lock(&entries_mutex);
+    snapshot_entry_t *entry = find_entry(stream_name);
+    if (entry) {
+        AVFrame *old = entry->frame;
+        entry->frame = copy;
+        entry->frame_seq++;
+        entry->frame_ms = now_ms();
+        entry->frame_time = time(NULL);
+        copy = old;
+    }
+    pthread_mutex_unlock(&entries_mutex);
+
+    // The replaced frame, or the new one if the entry went away meanwhile
+    av_frame_free(&copy);
+}
+
+/**
+ * Find the variant for a size and quality, or the one to replace
+ * Must be called with the entry's encode mutex held.
+ */
+static snapshot_variant_t *find_variant(snapshot_entry_t *entry, int width, int quality) {
+    snapshot_variant_t *oldest = &entry->variants[0];
+    for (int i = 0; i < SNAPSHOT_CACHE_VARIANTS; i++) {
+        snapshot_variant_t *variant = &entry->variants[i];
+        if (variant->jpeg && variant->width == width && variant->quality == quality) {
+            return variant;
+        }
+        if (!variant->jpeg) {
+            oldest = variant;
+        } else if (oldest->jpeg && variant->used_ms < oldest->used_ms) {
+            oldest = variant;
+        }
+    }
+
+    av_buffer_unref(&oldest->jpeg);
+    oldest->width = width;
+    oldest->quality = quality;
+    oldest->frame_seq = 0;
+    return oldest;
+}
+
+int snapshot_cache_get_jpeg(const char *stream_name, int width, int quality,
+                            AVBufferRef **jpeg, time_t *frame_time) {
+    return snapshot_cache_get_jpeg_every(stream_name, width, quality, SNAPSHOT_CACHE_INTERVAL_MS,
+                                         jpeg, frame_time);
+}
+
+int snapshot_cache_get_jpeg_every(const char *stream_name, int width, int quality, int interval_ms,
+                                  AVBufferRef **jpeg, time_t *frame_time) {
+    if (!stream_name || !jpeg) {
+        return -1;
+    }
+    if (interval_ms <= 0 || interval_ms > SNAPSHOT_CACHE_INTERVAL_MS) {
+        interval_ms = SNAPSHOT_CACHE_INTERVAL_MS;
+    }
+    *jpeg = NULL;
+
+    snapshot_entry_t *entry = get_entry(stream_name);
+    if (!entry) {
+        log_warn("Snapshot cache full, no snapshots for %s", stream_name);
+        return -1;
+    }
+
+    int64_t now = now_ms();
+    pthread_mutex_lock(&entries_mutex);
+    entry->requested_ms = now;
+    if (interval_ms < SNAPSHOT_CACHE_INTERVAL_MS) {
+        // Several callers with shorter intervals get the shortest
+        if (entry_interval(entry, now) == SNAPSHOT_CACHE_INTERVAL_MS || interval_ms <= entry->fast_interval_ms) {
+            entry->fast_interval_ms = interval_ms;
+        }
+        entry->fast_requested_ms = now;
+    }
+    bool have_frame = entry->frame != NULL;
+    pthread_mutex_unlock(&entries_mutex);
+
+    if (!have_frame) {
+        put_entry(entry);
+        return 1;
+    }
+
+    // Requests for the same image wait here and share the result
+    pthread_mutex_lock(&entry->encode_mutex);
+    snapshot_variant_t *variant = find_variant(entry, width, quality);
+    variant->used_ms = now;
+
+    AVFrame *frame = NULL;
+    uint64_t frame_seq = 0;
+    time_t taken = 0;
+    pthread_mutex_lock(&entries_mutex);
+    frame_seq = entry->frame_seq;
+    taken = entry->frame_time;
+    if (variant->frame_seq != frame_seq &&
+        (!variant->jpeg || now - variant->encoded_ms >= interval_ms)) {
+        frame = av_frame_clone(entry->frame);
+    }
+    pthread_mutex_unlock(&entries_mutex);
+
+    int ret = 0;
+    if (frame) {
+        const uint8_t *data = NULL;
+        size_t size = 0;
+        jpeg_encoder_t *encoder = jpeg_encoder_for_thread();
+        if (encoder && jpeg_encoder_encode_frame(encoder, frame, width, quality, &data, &size) == 0) {
+            AVBufferRef *buf = av_buffer_alloc(size);
+            if (buf) {
+                memcpy(buf->data, data, size);
+                av_buffer_unref(&variant->jpeg);
+                variant->jpeg = buf;
+                variant->frame_seq = frame_seq;
+                variant->frame_time = taken;
+                variant->encoded_ms = now;
+            }
+        } else {
+            log_error("Failed to encode snapshot of %s", stream_name);
+        }
+        av_frame_free(&frame);
+    }
+
+    if (variant->jpeg) {
+        *jpeg = av_buffer_ref(variant->jpeg);
+    }
+    if (!*jpeg) {
+        ret = -1;
+    } else if (frame_time) {
+        *frame_time = variant->frame_time;
+    }
+    pthread_mutex_unlock(&entry->encode_mutex);
+
+    put_entry(entry);
+    return ret;
+}
+
+void snapshot_cache_close(const char *stream_name) {
+    if (!stream_name) {
+        return;
+    }
+
+    pthread_mutex_lock(&entries_mutex);
+    for (int i = 0; i < MAX_STREAMS; i++) {
+        if (entries[i] && strcmp(entries[i]->stream_name, stream_name) == 0) {
+            remove_entry(i);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&entries_mutex);
+}
+
+void snapshot_cache_shutdown(void) {
+    pthread_mutex_lock(&entries_mutex);
+    for (int i = 0; i < MAX_STREAMS; i++) {
+        if (entries[i]) {
+            remove_entry(i);
+        }
+    }
+    pthread_mutex_unlock(&entries_mutex);
+}
@@ -2,6 +2,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
 #include <dlfcn.h>
 #include <pthread.h>
 #include <unistd.h>
@@ -16,9 +19,12 @@
 
 #include "core/logger.h"
 #include "core/config.h"  // For MAX_PATH_LENGTH
+#include "core/device_profile.h"
 #include "video/detection_result.h"
 #include "video/detection_model.h"
 #include "video/sod_detection.h"
+#include "video/detection_scheduler.h"
+#include "video/tensor_kernels.h"
 #include "sod/sod.h"
 
 // SOD library function pointers for dynamic loading
@@ -40,10 +46,17 @@ typedef struct {
 static sod_functions_t sod_funcs = {0};
 static bool sod_available = false;
 
+typedef struct sod_batch sod_batch_t;
+typedef struct shared_weights shared_weights_t;
+
 // SOD model structure
 typedef struct {
     void *model;                 // SOD model handle
     float threshold;             // Detection threshold
+    sod_batch_t *batch;          // Shared batching model, used instead of model when set
+    shared_weights_t *weights;   // Weights model runs on, NULL if it holds its own
+    float *frame;                // Last frame converted for SOD, reused by the next detection
+    size_t frame_capacity;       // Floats frame holds
 } sod_model_t;
 
 // SOD box structure (for dynamic loading)
@@ -57,6 +70,20 @@ typedef struct {
     void *pUserData;
 } sod_box_dynamic;
 
+/**
+ * Number of threads one inference may use: the cores divided between the
+ * detection workers, so concurrent detections do not oversubscribe the CPU
+ */
+static int sod_gemm_thread_count(void) {
+    int cores = device_profile_get()->cores;
+    if (cores <= 1) {
+        return 1;
+    }
+
+    int workers = device_profile_value(DEVICE_KNOB_DETECTION_WORKERS);
+    return workers > 0 && workers < cores ? cores / workers : 1;
+}
+
 // Generic model structure
 typedef struct {
     char type[16];               // Model type (sod)
@@ -64,6 +91,79 @@ typedef struct {
     char path[MAX_PATH_LENGTH];  // Path to the model file (for reference)
 } model_t;
 
+/*
+ * Shared weights
+ *
+ * The weights of a SOD model file are loaded once and shared by every network
+ * created for it, each with its own activations and workspace, so ten cameras
+ * on one model hold one copy of its weights. The network the weights were
+ * loaded into is never run; it is freed with the last network using it.
+ */
+
+// Model files whose weights are shared at once
+#define MAX_SHARED_SOD_WEIGHTS 8
+
+struct shared_weights {
+    char path[MAX_PATH_LENGTH];      // Model file
+    const char *arch;                // Built-in architecture of the model
+    sod_cnn *weights;                // Network holding the weights, NULL if the entry is free
+    int refs;                        // Networks running on the weights
+};
+
+static shared_weights_t shared_weights[MAX_SHARED_SOD_WEIGHTS];
+static pthread_mutex_t shared_weights_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Batched models
+ *
+ * With detection_batch_size above 1, the streams using the same SOD model
+ * share one copy of it, and the detection workers that bring frames at about
+ * the same time run them through the network together, so every weight is
+ * loaded once per batch instead of once per frame. The first frame of a
+ * batch leads it: it waits up to detection_batch_window_ms for frames of the
+ * other queued jobs, then runs the batch and fills in every result while the
+ * other callers wait. Frames arriving meanwhile form the next batch.
+ */
+
+// Most frames in one batch, whatever the model and configuration allow
+#define SOD_BATCH_MAX_FRAMES 16
+
+// Models shared by batching streams
+#define MAX_SOD_BATCH_MODELS 8
+
+struct sod_batch {
+    char path[MAX_PATH_LENGTH];      // Model file, the key the streams share it by
+    sod_cnn *net;                    // Network, allocated for capacity images
+    shared_weights_t *weights;       // Weights the network runs on
+    int refs;                        // Streams using the model
+    int capacity;                    // Frames per batch
+    int input_size;                  // Floats of one network input
+    int net_width;
+    int net_height;
+    float threshold;                 // Lowest threshold of the streams, the network reports boxes above it
+    float *inputs;                   // Network inputs of the forming batch, back to back
+
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;             // Signaled when a frame joins or a batch starts or finishes
+
+    // Forming batch
+    int count;
+    int widths[SOD_BATCH_MAX_FRAMES];
+    int heights[SOD_BATCH_MAX_FRAMES];
+    float thresholds[SOD_BATCH_MAX_FRAMES];
+    detection_result_t *results[SOD_BATCH_MAX_FRAMES];
+    int *status[SOD_BATCH_MAX_FRAMES];
+    uint64_t generation;             // Sequence number of the forming batch
+    uint64_t finished;               // Sequence number of the last batch that ran
+    bool running;                    // The network is running a batch
+};
+
+static sod_batch_t *batch_models[MAX_SOD_BATCH_MODELS] = {NULL};
+static pthread_mutex_t batch_models_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void release_sod_batch(sod_batch_t *batch);
+static void destroy_sod_network(sod_cnn *net, shared_weights_t *weights);
+
 /**
  * Initialize the SOD detection system
  * Handles both static and dynamic linking cases
@@ -155,6 +255,18 @@ void cleanup_sod_model(detection_model_t model) {
 
     log_info("Cleaning up SOD model: %s", m->path);
 
+    // A shared model goes away with the last stream using it
+    free(m->sod.frame);
+    m->sod.frame = NULL;
+
+    if (m->sod.batch) {
+        release_sod_batch(m->sod.batch);
+        m->sod.batch = NULL;
+        free(m);
+        log_info("SOD model cleanup complete");
+        return;
+    }
+
     // Clean up the SOD model - use a local variable to avoid double-free issues
     void *sod_model_ptr = m->sod.model;
 
@@ -175,7 +287,8 @@ void cleanup_sod_model(detection_model_t model) {
             // which is what was causing the Valgrind errors
             void *temp = sod_model_ptr;
             sod_model_ptr = NULL;
-            sod_cnn_destroy(temp);
+            destroy_sod_network(temp, m->sod.weights);
+            m->sod.weights = NULL;
         }
     }
 
@@ -193,21 +306,9 @@ bool is_sod_available(void) {
 }
 
 /**
- * Load a SOD model
+ * Pick the built-in architecture of a model from its file name
  */
-detection_model_t load_sod_model(const char *model_path, float threshold) {
-    if (!sod_available) {
-        log_error("SOD library not available");
-        return NULL;
-    }
-
-    // Load the model using SOD API
-    void *sod_model = NULL;
-    const char *err_msg = NULL;
-
-    // Create CNN model
-    int rc;
-
+static const char *sod_model_arch(const char *model_path) {
     // Check if this is a face detection model based on filename or path
     const char *arch = "default";
 
@@ -239,17 +340,300 @@ detection_model_t load_sod_model(const char *model_path, float threshold) {
         arch = ":face";
     }
 
+    return arch;
+}
+
+/**
+ * Load the weights of a model, with its int8 weights when present
+ */
+static sod_cnn *load_sod_weights(const char *model_path, const char *arch) {
+    const char *err_msg = NULL;
+
     // Use static linking
     sod_cnn *cnn_model = NULL;
-    rc = sod_cnn_create(&cnn_model, arch, model_path, &err_msg);
+    int rc = sod_cnn_create(&cnn_model, arch, model_path, &err_msg);
 
     if (rc != 0 || !cnn_model) {  // SOD_OK is 0
         log_error("Failed to load SOD model: %s - %s", model_path, err_msg ? err_msg : "Unknown error");
         return NULL;
     }
 
-    // Store the model pointer
-    sod_model = cnn_model;
+    // An int8 model written by sod_quantize next to the model replaces its float weights
+    char int8_path[MAX_PATH_LENGTH];
+    struct stat int8_st;
+    snprintf(int8_path, sizeof(int8_path), "%s%s", model_path, SOD_INT8_MODEL_SUFFIX);
+    if (stat(int8_path, &int8_st) == 0) {
+        if (sod_cnn_config(cnn_model, SOD_CNN_INT8_MODEL, int8_path) == SOD_OK) {
+            log_info("Using int8 weights for SOD model: %s", int8_path);
+        } else {
+            log_warn("Ignoring int8 weights %s, keeping float inference", int8_path);
+        }
+    }
+
+    return cnn_model;
+}
+
+/**
+ * Create a SOD network for a model, configured for detection
+ * The network runs on the shared weights of the model, loaded on first use.
+ *
+ * @param model_path Path to the model file
+ * @param threshold Detection confidence threshold
+ * @param weights Receives the shared weights the network uses, to release
+ *                with it, or NULL if the network holds its own
+ * @return Network or NULL on failure
+ */
+static sod_cnn *create_sod_network(const char *model_path, float threshold, shared_weights_t **weights) {
+    *weights = NULL;
+
+    pthread_mutex_lock(&shared_weights_mutex);
+    shared_weights_t *entry = NULL;
+    shared_weights_t *free_entry = NULL;
+    for (int i = 0; i < MAX_SHARED_SOD_WEIGHTS; i++) {
+        if (!shared_weights[i].weights) {
+            if (!free_entry) {
+                free_entry = &shared_weights[i];
+            }
+        } else if (strcmp(shared_weights[i].path, model_path) == 0) {
+            entry = &shared_weights[i];
+            break;
+        }
+    }
+
+    sod_cnn *cnn_model = NULL;
+    if (entry) {
+        const char *err_msg = NULL;
+        if (sod_cnn_create_shared(&cnn_model, entry->arch, entry->weights, &err_msg) != SOD_OK) {
+            pthread_mutex_unlock(&shared_weights_mutex);
+            log_error("Failed to create SOD network for %s - %s", model_path, err_msg ? err_msg : "Unknown error");
+            return NULL;
+        }
+        entry->refs++;
+        *weights = entry;
+        log_info("Sharing the weights of SOD model %s (%d networks)", model_path, entry->refs);
+    } else {
+        const char *arch = sod_model_arch(model_path);
+        sod_cnn *loaded = load_sod_weights(model_path, arch);
+        if (!loaded) {
+            pthread_mutex_unlock(&shared_weights_mutex);
+            return NULL;
+        }
+
+        const char *err_msg = NULL;
+        if (free_entry && sod_cnn_create_shared(&cnn_model, arch, loaded, &err_msg) == SOD_OK) {
+            strncpy(free_entry->path, model_path, MAX_PATH_LENGTH - 1);
+            free_entry->path[MAX_PATH_LENGTH - 1] = '\0';
+            free_entry->arch = arch;
+            free_entry->weights = loaded;
+            free_entry->refs = 1;
+            *weights = free_entry;
+        } else {
+            // Networks whose weights cannot be shared run on their own copy
+            log_info("SOD model %s keeps its own weights%s%s", model_path,
+                     err_msg ? ": " : "", err_msg ? err_msg : "");
+            cnn_model = loaded;
+        }
+    }
+    pthread_mutex_unlock(&shared_weights_mutex);
+
+    // Use static linking
+    sod_cnn_config(cnn_model, SOD_CNN_DETECTION_THRESHOLD, threshold);
+
+    // Cores the detection workers leave idle split each layer's matrix products
+    int gemm_threads = sod_gemm_thread_count();
+    if (gemm_threads > 1) {
+        sod_cnn_config(cnn_model, SOD_CNN_GEMM_THREADS, gemm_threads);
+    }
+
+    // Layers the GPU kernels do not cover keep running on the CPU
+    if (g_config.sod_opencl) {
+        static bool opencl_warned = false;
+        if (sod_cnn_config(cnn_model, SOD_CNN_OPENCL, 1) != SOD_OK && !opencl_warned) {
+            opencl_warned = true;
+            log_warn("OpenCL is not available to SOD (built without SOD_OPENCL or no GPU driver), running on the CPU");
+        }
+    }
+
+    return cnn_model;
+}
+
+/**
+ * Destroy a network made by create_sod_network, and the weights it shared
+ * once no other network uses them
+ */
+static void destroy_sod_network(sod_cnn *net, shared_weights_t *weights) {
+    sod_cnn_destroy(net);
+    if (!weights) {
+        return;
+    }
+
+    pthread_mutex_lock(&shared_weights_mutex);
+    sod_cnn *loaded = NULL;
+    if (--weights->refs == 0) {
+        loaded = weights->weights;
+        weights->weights = NULL;
+        weights->path[0] = '\0';
+    }
+    pthread_mutex_unlock(&shared_weights_mutex);
+
+    if (loaded) {
+        log_info("Freeing the shared weights of SOD model");
+        sod_cnn_destroy(loaded);
+    }
+}
+
+/**
+ * Frames a shared model batches: the configured batch size, bounded by the
+ * detection workers since each frame of a batch is brought by one of them
+ *
+ * @return Batch size, 1 or less when batching is off
+ */
+static int sod_batch_size(void) {
+    int size = g_config.detection_batch_size;
+    int workers = detection_scheduler_worker_count();
+    if (size > workers) {
+        size = workers;
+    }
+    if (size > SOD_BATCH_MAX_FRAMES) {
+        size = SOD_BATCH_MAX_FRAMES;
+    }
+    return size;
+}
+
+/**
+ * Get the shared batching model of a model file, loading it on first use
+ *
+ * @param model_path Path to the model file
+ * @param threshold Detection threshold of the stream
+ * @param single Receives the network when the model cannot batch, so the
+ *               caller can use it on its own instead of creating another
+ * @param single_weights Receives the shared weights of that network
+ * @return Shared model, or NULL if the model is not batched
+ */
+static sod_batch_t *acquire_sod_batch(const char *model_path, float threshold, sod_cnn **single,
+                                      shared_weights_t **single_weights) {
+    *single = NULL;
+    *single_weights = NULL;
+
+    int size = sod_batch_size();
+    if (size < 2) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&batch_models_mutex);
+    int free_index = -1;
+    for (int i = 0; i < MAX_SOD_BATCH_MODELS; i++) {
+        sod_batch_t *batch = batch_models[i];
+        if (!batch) {
+            if (free_index < 0) {
+                free_index = i;
+            }
+            continue;
+        }
+        if (strcmp(batch->path, model_path) == 0) {
+            pthread_mutex_lock(&batch->mutex);
+            int refs = ++batch->refs;
+            if (threshold < batch->threshold) {
+                batch->threshold = threshold;
+                sod_cnn_config(batch->net, SOD_CNN_DETECTION_THRESHOLD, threshold);
+            }
+            pthread_mutex_unlock(&batch->mutex);
+            pthread_mutex_unlock(&batch_models_mutex);
+            log_info("Sharing batched SOD model %s (%d streams)", model_path, refs);
+            return batch;
+        }
+    }
+
+    shared_weights_t *weights = NULL;
+    sod_cnn *net = create_sod_network(model_path, threshold, &weights);
+    if (!net) {
+        pthread_mutex_unlock(&batch_models_mutex);
+        return NULL;
+    }
+
+    int capacity = 1;
+    sod_cnn_config(net, SOD_CNN_BATCH_CAPACITY, &capacity);
+    if (capacity > size) {
+        capacity = size;
+    }
+    if (capacity < 2 || free_index < 0) {
+        pthread_mutex_unlock(&batch_models_mutex);
+        log_info("SOD model %s runs one frame at a time (batch capacity %d)", model_path, capacity);
+        *single = net;
+        *single_weights = weights;
+        return NULL;
+    }
+
+    sod_batch_t *batch = (sod_batch_t *)calloc(1, sizeof(sod_batch_t));
+    int channels = 0;
+    if (batch) {
+        sod_cnn_get_network_size(net, &batch->net_width, &batch->net_height, &channels);
+        batch->input_size = batch->net_width * batch->net_height * channels;
+        batch->inputs = (float *)malloc((size_t)capacity * batch->input_size * sizeof(float));
+    }
+    if (!batch || !batch->inputs) {
+        pthread_mutex_unlock(&batch_models_mutex);
+        log_warn("Failed to allocate the batch of SOD model %s, running one frame at a time", model_path);
+        if (batch) {
+            free(batch);
+        }
+        *single = net;
+        *single_weights = weights;
+        return NULL;
+    }
+
+    strncpy(batch->path, model_path, MAX_PATH_LENGTH - 1);
+    batch->path[MAX_PATH_LENGTH - 1] = '\0';
+    batch->net = net;
+    batch->weights = weights;
+    batch->refs = 1;
+    batch->capacity = capacity;
+    batch->threshold = threshold;
+    pthread_mutex_init(&batch->mutex, NULL);
+    pthread_cond_init(&batch->cond, NULL);
+    batch_models[free_index] = batch;
+    pthread_mutex_unlock(&batch_models_mutex);
+
+    log_info("Batching SOD model %s: up to %d frames per pass, %d ms window",
+             model_path, capacity, g_config.detection_batch_window_ms);
+    return batch;
+}
+
+/**
+ * Drop a stream's reference to a shared model, freeing it with the last one
+ */
+static void release_sod_batch(sod_batch_t *batch) {
+    pthread_mutex_lock(&batch_models_mutex);
+    pthread_mutex_lock(&batch->mutex);
+    int refs = --batch->refs;
+    pthread_mutex_unlock(&batch->mutex);
+    if (refs > 0) {
+        pthread_mutex_unlock(&batch_models_mutex);
+        return;
+    }
+    for (int i = 0; i < MAX_SOD_BATCH_MODELS; i++) {
+        if (batch_models[i] == batch) {
+            batch_models[i] = NULL;
+        }
+    }
+    pthread_mutex_unlock(&batch_models_mutex);
+
+    log_info("Destroying batched SOD model: %s", batch->path);
+    destroy_sod_network(batch->net, batch->weights);
+    pthread_mutex_destroy(&batch->mutex);
+    pthread_cond_destroy(&batch->cond);
+    free(batch->inputs);
+    free(batch);
+}
+
+/**
+ * Load a SOD model
+ */
+detection_model_t load_sod_model(const char *model_path, float threshold) {
+    if (!sod_available) {
+        log_error("SOD library not available");
+        return NULL;
+    }
 
     // Set detection threshold - use same threshold as spec if not specified
     if (threshold <= 0.0f) {
@@ -257,21 +641,38 @@ detection_model_t load_sod_model(const char *model_path, float threshold) {
         log_info("Using default threshold of 0.3 for model %s", model_path);
     }
 
-    // Use static linking
-    sod_cnn_config(cnn_model, SOD_CNN_DETECTION_THRESHOLD, threshold);
+    // Streams batching the model share one copy of it
+    sod_cnn *cnn_model = NULL;
+    shared_weights_t *weights = NULL;
+    sod_batch_t *batch = acquire_sod_batch(model_path, threshold, &cnn_model, &weights);
+    if (!batch && !cnn_model) {
+        cnn_model = create_sod_network(model_path, threshold, &weights);
+        if (!cnn_model) {
+            return NULL;
+        }
+    }
 
     // Create model structure
     model_t *model = (model_t *)malloc(sizeof(model_t));
     if (!model) {
         log_error("Failed to allocate memory for model structure");
-        sod_cnn_destroy(sod_model);
+        if (batch) {
+            release_sod_batch(batch);
+        } else {
+            destroy_sod_network(cnn_model, weights);
+        }
         return NULL;
     }
 
     // Initialize model structure
     strncpy(model->type, MODEL_TYPE_SOD, sizeof(model->type) - 1);
-    model->sod.model = sod_model;
+    model->type[sizeof(model->type) - 1] = '\0';
+    model->sod.model = cnn_model;
     model->sod.threshold = threshold;
+    model->sod.batch = batch;
+    model->sod.weights = weights;
+    model->sod.frame = NULL;
+    model->sod.frame_capacity = 0;
 
     // Store the model path in the model structure
     strncpy(model->path, model_path, MAX_PATH_LENGTH - 1);
@@ -282,115 +683,280 @@ detection_model_t load_sod_model(const char *model_path, float threshold) {
 }
 
 /**
- * Run detection on a frame using SOD
+ * Convert SOD boxes to a detection result, keeping the boxes above threshold
  */
-int detect_with_sod_model(detection_model_t model, const unsigned char *frame_data,
-    int width, int height, int channels, detection_result_t *result) {
-    if (!model || !frame_data || !result) {
-        log_error("Invalid parameters for detect_with_sod_model: model=%p, frame_data=%p, result=%p",
-                 model, frame_data, result);
-        return -1;
+static void fill_detection_result(sod_box *boxes, int count, int width, int height,
+                                  float threshold, detection_result_t *result) {
+    result->count = 0;
+    int valid_count = 0;
+
+    log_info("Processing %d detection boxes", count);
+
+    // For static linking, boxes is already an array of sod_box structures
+
+    for (int i = 0; i < count && valid_count < MAX_DETECTIONS; i++) {
+        // Get the current box - with bounds checking
+        if (i < 0 || i >= count) {
+            log_warn("Box index %d out of bounds (count=%d), skipping", i, count);
+            continue;
+        }
+
+        sod_box *box = &boxes[i];
+
+        // This check is redundant since box is a reference, not a pointer
+        // but we'll keep a modified version for safety
+        if (box == NULL) {
+            log_warn("Box %d is NULL, skipping", i);
+            continue;
+        }
+
+        // Log box values for debugging
+        log_info("Box %d: x=%d, y=%d, w=%d, h=%d, score=%.2f, name=%s",
+                i, box->x, box->y, box->w, box->h, box->score,
+                box->zName ? box->zName : "unknown");
+
+        // CRITICAL FIX: Add extra validation for box values
+        if (box->x < 0 || box->y < 0 || box->w <= 0 || box->h <= 0 ||
+            box->x + box->w > width || box->y + box->h > height) {
+            log_warn("Box %d has invalid coordinates (x=%d, y=%d, w=%d, h=%d, img_w=%d, img_h=%d), skipping",
+                    i, box->x, box->y, box->w, box->h, width, height);
+            continue;
+        }
+
+        // Validate zName pointer
+        if (box->zName == NULL) {
+            log_warn("Box %d has NULL name, using 'unknown'", i);
+        }
+
+        char label[MAX_LABEL_LENGTH];
+        const char *name = box->zName ? box->zName : "object";
+
+        // Extra safety check for name string
+        if (name && strlen(name) > 0) {
+            strncpy(label, name, MAX_LABEL_LENGTH - 1);
+        } else {
+            strncpy(label, "object", MAX_LABEL_LENGTH - 1);
+        }
+        label[MAX_LABEL_LENGTH - 1] = '\0';
+
+        // Clamp confidence to valid range [0.0, 1.0]
+        float confidence = box->score;
+        if (confidence > 1.0f) confidence = 1.0f;
+        if (confidence < 0.0f) confidence = 0.0f;
+
+        // Convert pixel coordinates to normalized 0-1 range with safety checks
+        float x = (width > 0) ? ((float)box->x / width) : 0.0f;
+        float y = (height > 0) ? ((float)box->y / height) : 0.0f;
+        float w = (width > 0) ? ((float)box->w / width) : 0.0f;
+        float h = (height > 0) ? ((float)box->h / height) : 0.0f;
+
+        // Clamp values to [0.0, 1.0] range
+        x = (x < 0.0f) ? 0.0f : (x > 1.0f ? 1.0f : x);
+        y = (y < 0.0f) ? 0.0f : (y > 1.0f ? 1.0f : y);
+        w = (w < 0.0f) ? 0.0f : (w > 1.0f ? 1.0f : w);
+        h = (h < 0.0f) ? 0.0f : (h > 1.0f ? 1.0f : h);
+
+        // Apply threshold
+        if (confidence < threshold) {
+            log_info("Detection %d below threshold: %s (%.2f%%) at [%.2f, %.2f, %.2f, %.2f]",
+                    i, label, confidence * 100.0f, x, y, w, h);
+            continue;
+        }
+
+        // Add valid detection to result
+        strncpy(result->detections[valid_count].label, label, MAX_LABEL_LENGTH - 1);
+        result->detections[valid_count].confidence = confidence;
+        result->detections[valid_count].x = x;
+        result->detections[valid_count].y = y;
+        result->detections[valid_count].width = w;
+        result->detections[valid_count].height = h;
+
+        log_info("Valid detection %d: %s (%.2f%%) at [%.2f, %.2f, %.2f, %.2f]",
+                valid_count, label, confidence * 100.0f, x, y, w, h);
+
+        valid_count++;
     }
 
-    // Validate dimensions
-    if (width <= 0 || height <= 0 || channels <= 0 || channels > 4) {
-        log_error("Invalid dimensions for detect_with_sod_model: width=%d, height=%d, channels=%d",
-                 width, height, channels);
-        return -1;
+    result->count = valid_count;
+    log_info("Detection found %d valid objects out of %d total", valid_count, count);
+}
+
+static void deadline_after_ms(struct timespec *deadline, int ms) {
+    clock_gettime(CLOCK_REALTIME, deadline);
+    deadline->tv_sec += ms / 1000;
+    deadline->tv_nsec += (long)(ms % 1000) * 1000000;
+    if (deadline->tv_nsec >= 1000000000) {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000;
     }
+}
 
-    model_t *m = (model_t *)model;
-    if (strcmp(m->type, MODEL_TYPE_SOD) != 0) {
-        log_error("Invalid model type for detect_with_sod_model: %s", m->type);
-        return -1;
+/**
+ * Run detection on a SOD image through a shared model, as part of a batch
+ *
+ * @return 0 on success, -1 on failure
+ */
+static int detect_batched(sod_batch_t *batch, sod_img img, int width, int height,
+                          float threshold, detection_result_t *result) {
+    int status = -1;
+    result->count = 0;
+
+    pthread_mutex_lock(&batch->mutex);
+
+    // Wait for room in the forming batch
+    while (batch->running || batch->count >= batch->capacity) {
+        pthread_cond_wait(&batch->cond, &batch->mutex);
     }
 
-    if (!sod_available) {
-        log_error("SOD library not available");
+    int index = batch->count;
+    uint64_t generation = batch->generation;
+    float *input = batch->inputs + (size_t)index * batch->input_size;
+
+    float *prepared = sod_cnn_prepare_image(batch->net, img);
+    if (!prepared) {
+        pthread_mutex_unlock(&batch->mutex);
+        log_error("Failed to prepare image for CNN detection");
         return -1;
     }
+    memcpy(input, prepared, batch->input_size * sizeof(float));
+
+    batch->widths[index] = width;
+    batch->heights[index] = height;
+    batch->thresholds[index] = threshold;
+    batch->results[index] = result;
+    batch->status[index] = &status;
+    batch->count++;
+    pthread_cond_broadcast(&batch->cond);
+
+    if (index > 0) {
+        // The first frame of the batch runs it
+        while (batch->finished < generation) {
+            pthread_cond_wait(&batch->cond, &batch->mutex);
+        }
+        pthread_mutex_unlock(&batch->mutex);
+        return status;
+    }
 
-    // Step 1: Create a SOD image
-    log_info("Step 1: Creating SOD image from frame data (dimensions: %dx%d, channels: %d)",
-            width, height, channels);
+    // Wait for the frames of the other queued jobs, up to the window
+    struct timespec deadline;
+    deadline_after_ms(&deadline, g_config.detection_batch_window_ms > 0 ? g_config.detection_batch_window_ms : 0);
+    while (batch->count < batch->capacity && batch->count < detection_scheduler_active_jobs()) {
+        if (pthread_cond_timedwait(&batch->cond, &batch->mutex, &deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
 
-    sod_img img = sod_make_image(width, height, channels);
-    if (!img.data) {
-        log_error("Failed to create SOD image");
-        return -1;
+    int count = batch->count;
+    batch->running = true;
+    pthread_mutex_unlock(&batch->mutex);
+
+    // The workers waiting on the batch lend it their cores
+    int threads = sod_gemm_thread_count() * count;
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cores > 0 && threads > cores) {
+        threads = (int)cores;
     }
 
-    // Step 2: Copy the frame data to the SOD image
-    log_info("Step 2: Copying frame data to SOD image");
+    log_info("Running a batch of %d frames through SOD model %s", count, batch->path);
+    int rc = sod_cnn_predict_batch(batch->net, batch->inputs, count, threads);
+    for (int i = 0; i < count; i++) {
+        if (rc != SOD_OK) {
+            log_error("Batched CNN detection failed with error code: %d", rc);
+            continue;
+        }
 
-    // Calculate the total size of the image data with overflow check
-    size_t pixel_count = (size_t)width * (size_t)height;
-    if (pixel_count / width != height) { // Check for overflow
-        log_error("Integer overflow in image dimensions: width=%d, height=%d", width, height);
-        sod_free_image(img);
-        return -1;
+        sod_box *boxes = NULL;
+        int box_count = 0;
+        if (sod_cnn_batch_boxes(batch->net, i, batch->widths[i], batch->heights[i], &boxes, &box_count) != SOD_OK) {
+            continue;
+        }
+        if (boxes && box_count > 0) {
+            fill_detection_result(boxes, box_count, batch->widths[i], batch->heights[i],
+                                  batch->thresholds[i], batch->results[i]);
+        }
+        *batch->status[i] = 0;
     }
 
-    size_t total_size = pixel_count * channels;
-    if (total_size / pixel_count != channels) { // Check for overflow
-        log_error("Integer overflow in total size calculation: width=%d, height=%d, channels=%d",
-                 width, height, channels);
-        sod_free_image(img);
-        return -1;
+    pthread_mutex_lock(&batch->mutex);
+    batch->count = 0;
+    batch->generation++;
+    batch->finished = generation;
+    batch->running = false;
+    pthread_cond_broadcast(&batch->cond);
+    pthread_mutex_unlock(&batch->mutex);
+
+    return status;
+}
+
+/**
+ * Make room for floats in the frame buffer of the model
+ * The buffer is kept between detections and only grows, so steady-state
+ * detection allocates nothing.
+ *
+ * @return The buffer, NULL on allocation failure
+ */
+static float *reserve_frame_buffer(sod_model_t *sod, size_t floats) {
+    if (floats > sod->frame_capacity) {
+        float *frame = (float *)realloc(sod->frame, floats * sizeof(float));
+        if (!frame) {
+            log_error("Failed to allocate the SOD frame buffer (size=%zu bytes)", floats * sizeof(float));
+            return NULL;
+        }
+        sod->frame = frame;
+        sod->frame_capacity = floats;
     }
+    return sod->frame;
+}
 
-    // Allocate a temporary buffer to store the converted data
-    float *temp_buffer = (float *)malloc(total_size * sizeof(float));
-    if (!temp_buffer) {
-        log_error("Failed to allocate temporary buffer for image data conversion (size=%zu bytes)",
-                 total_size * sizeof(float));
-        sod_free_image(img);
-        return -1;
+/**
+ * Convert an interleaved 8-bit frame to the planar 0-1 floats SOD works on,
+ * in the frame buffer of the model
+ *
+ * @return SOD image over the buffer of the model, with NULL data on failure
+ */
+static sod_img frame_to_sod_image(sod_model_t *sod, const unsigned char *frame_data,
+                                  int width, int height, int channels) {
+    sod_img img = {0};
+
+    // Calculate the total size of the image data with overflow check
+    size_t pixel_count = (size_t)width * (size_t)height;
+    if (pixel_count / width != (size_t)height || pixel_count > SIZE_MAX / sizeof(float) / channels) {
+        log_error("Integer overflow in image dimensions: width=%d, height=%d, channels=%d",
+                 width, height, channels);
+        return img;
     }
 
-    // Initialize the temp buffer to zeros for safety
-    memset(temp_buffer, 0, total_size * sizeof(float));
+    if (!reserve_frame_buffer(sod, pixel_count * channels)) {
+        return img;
+    }
 
     // Convert the frame data from HWC to CHW format and from 0-255 to 0-1 range
     for (int c = 0; c < channels; c++) {
-        for (int h = 0; h < height; h++) {
-            for (int w = 0; w < width; w++) {
-                // Calculate the index in the SOD image (CHW format) with overflow checks
-                size_t c_offset = (size_t)c * (size_t)height * (size_t)width;
-                size_t h_offset = (size_t)h * (size_t)width;
-                size_t sod_idx = c_offset + h_offset + w;
-
-                // Calculate the index in the frame data (HWC format) with overflow checks
-                size_t row_offset = (size_t)h * (size_t)width * (size_t)channels;
-                size_t pixel_offset = (size_t)w * (size_t)channels;
-                size_t frame_idx = row_offset + pixel_offset + c;
-
-                // Make sure the indices are within bounds
-                if (sod_idx < total_size && frame_idx < total_size) {
-                    // Convert from 0-255 to 0-1 range
-                    temp_buffer[sod_idx] = frame_data[frame_idx] / 255.0f;
-                } else {
-                    log_warn("Index out of bounds: sod_idx=%zu, frame_idx=%zu, total_size=%zu",
-                             sod_idx, frame_idx, total_size);
-                }
-            }
+        float *plane = sod->frame + (size_t)c * pixel_count;
+        const unsigned char *src = frame_data + c;
+        for (size_t i = 0; i < pixel_count; i++) {
+            plane[i] = src[i * channels] / 255.0f;
         }
     }
 
-    // Copy the converted data to the SOD image with NULL check
-    if (img.data != NULL) {
-        memcpy(img.data, temp_buffer, total_size * sizeof(float));
-    } else {
-        log_error("SOD image data pointer is NULL");
-        free(temp_buffer);
-        sod_free_image(img);
-        return -1;
-    }
-
-    // Free the temporary buffer
-    free(temp_buffer);
+    img.w = width;
+    img.h = height;
+    img.c = channels;
+    img.data = sod->frame;
+    return img;
+}
 
-    log_info("Step 3: Successfully copied frame data to SOD image");
+/**
+ * Run a SOD image through the network of a model and fill in the result
+ * Box coordinates are normalized to width x height, the size the image
+ * stands for.
+ *
+ * @return 0 on success, -1 on failure
+ */
+static int detect_sod_image(model_t *m, sod_img img, int width, int height, detection_result_t *result) {
+    if (m->sod.batch) {
+        return detect_batched(m->sod.batch, img, width, height, m->sod.threshold, result);
+    }
 
     // Step 3: Prepare the image for CNN detection
     log_info("Step 4: Preparing image for CNN detection with model=%p", (void*)m->sod.model);
@@ -399,14 +965,12 @@ int detect_with_sod_model(detection_model_t model, const unsigned char *frame_da
     // Extra safety check for model pointer
     if (!m->sod.model) {
         log_error("Model pointer is NULL before preparing image");
-        sod_free_image(img);
         return -1;
     }
 
     prepared_data = sod_cnn_prepare_image(m->sod.model, img);
     if (!prepared_data) {
         log_error("Failed to prepare image for CNN detection");
-        sod_free_image(img);
         return -1;
     }
 
@@ -421,7 +985,6 @@ int detect_with_sod_model(detection_model_t model, const unsigned char *frame_da
     if (!m->sod.model) {
         log_error("Model pointer is NULL before prediction");
         // prepared_data is freed when we free the image
-        sod_free_image(img);
         return -1;
     }
 
@@ -432,7 +995,6 @@ int detect_with_sod_model(detection_model_t model, const unsigned char *frame_da
     // Extra safety check for prepared_data
     if (!prepared_data) {
         log_error("Prepared data is NULL before prediction");
-        sod_free_image(img);
         return -1;
     }
 
@@ -442,7 +1004,6 @@ int detect_with_sod_model(detection_model_t model, const unsigned char *frame_da
 
     if (rc != 0) { // SOD_OK is 0
         log_error("CNN detection failed with error code: %d", rc);
-        sod_free_image(img); // This also frees prepared_data
         return -1;
     }
 
@@ -464,106 +1025,115 @@ int detect_with_sod_model(detection_model_t model, const unsigned char *frame_da
     // Skip processing boxes if count is 0 or boxes is NULL
     if (count <= 0 || !boxes) {
         log_warn("No detection boxes returned (count=%d, boxes=%p)", count, (void*)boxes);
-        sod_free_image(img); // This also frees prepared_data
         result->count = 0; // Ensure result is properly initialized
         return 0;
     }
 
-    log_info("Processing %d detection boxes", count);
-
-    // For static linking, boxes is already an array of sod_box structures
-
-    for (int i = 0; i < count && valid_count < MAX_DETECTIONS; i++) {
-        // Get the current box - with bounds checking
-        if (i < 0 || i >= count) {
-            log_warn("Box index %d out of bounds (count=%d), skipping", i, count);
-            continue;
-        }
+    fill_detection_result(boxes, count, width, height, m->sod.threshold, result);
 
-        sod_box *box = &boxes[i];
+    // The frame buffer and prepared data belong to the model and serve the next detection
+    return 0;
+}
 
-        // This check is redundant since box is a reference, not a pointer
-        // but we'll keep a modified version for safety
-        if (box == NULL) {
-            log_warn("Box %d is NULL, skipping", i);
-            continue;
-        }
+/**
+ * Run detection on a frame using SOD
+ */
+int detect_with_sod_model(detection_model_t model, const unsigned char *frame_data,
+    int width, int height, int channels, detection_result_t *result) {
+    if (!model || !frame_data || !result) {
+        log_error("Invalid parameters for detect_with_sod_model: model=%p, frame_data=%p, result=%p",
+                 model, frame_data, result);
+        return -1;
+    }
 
-        // Log box values for debugging
-        log_info("Box %d: x=%d, y=%d, w=%d, h=%d, score=%.2f, name=%s",
-                i, box->x, box->y, box->w, box->h, box->score,
-                box->zName ? box->zName : "unknown");
+    // Validate dimensions
+    if (width <= 0 || height <= 0 || channels <= 0 || channels > 4) {
+        log_error("Invalid dimensions for detect_with_sod_model: width=%d, height=%d, channels=%d",
+                 width, height, channels);
+        return -1;
+    }
 
-        // CRITICAL FIX: Add extra validation for box values
-        if (box->x < 0 || box->y < 0 || box->w <= 0 || box->h <= 0 ||
-            box->x + box->w > width || box->y + box->h > height) {
-            log_warn("Box %d has invalid coordinates (x=%d, y=%d, w=%d, h=%d, img_w=%d, img_h=%d), skipping",
-                    i, box->x, box->y, box->w, box->h, width, height);
-            continue;
-        }
+    model_t *m = (model_t *)model;
+    if (strcmp(m->type, MODEL_TYPE_SOD) != 0) {
+        log_error("Invalid model type for detect_with_sod_model: %s", m->type);
+        return -1;
+    }
 
-        // Validate zName pointer
-        if (box->zName == NULL) {
-            log_warn("Box %d has NULL name, using 'unknown'", i);
-        }
+    if (!sod_available) {
+        log_error("SOD library not available");
+        return -1;
+    }
 
-        char label[MAX_LABEL_LENGTH];
-        const char *name = box->zName ? box->zName : "object";
+    // Step 1: Convert the frame into the buffer of the model
+    log_info("Step 1: Converting frame data to SOD image (dimensions: %dx%d, channels: %d)",
+            width, height, channels);
 
-        // Extra safety check for name string
-        if (name && strlen(name) > 0) {
-            strncpy(label, name, MAX_LABEL_LENGTH - 1);
-        } else {
-            strncpy(label, "object", MAX_LABEL_LENGTH - 1);
-        }
-        label[MAX_LABEL_LENGTH - 1] = '\0';
+    sod_img img = frame_to_sod_image(&m->sod, frame_data, width, height, channels);
+    if (!img.data) {
+        log_error("Failed to create SOD image");
+        return -1;
+    }
 
-        // Clamp confidence to valid range [0.0, 1.0]
-        float confidence = box->score;
-        if (confidence > 1.0f) confidence = 1.0f;
-        if (confidence < 0.0f) confidence = 0.0f;
+    log_info("Step 3: Successfully converted frame data to SOD image");
 
-        // Convert pixel coordinates to normalized 0-1 range with safety checks
-        float x = (width > 0) ? ((float)box->x / width) : 0.0f;
-        float y = (height > 0) ? ((float)box->y / height) : 0.0f;
-        float w = (width > 0) ? ((float)box->w / width) : 0.0f;
-        float h = (height > 0) ? ((float)box->h / height) : 0.0f;
+    return detect_sod_image(m, img, width, height, result);
+}
 
-        // Clamp values to [0.0, 1.0] range
-        x = (x < 0.0f) ? 0.0f : (x > 1.0f ? 1.0f : x);
-        y = (y < 0.0f) ? 0.0f : (y > 1.0f ? 1.0f : y);
-        w = (w < 0.0f) ? 0.0f : (w > 1.0f ? 1.0f : w);
-        h = (h < 0.0f) ? 0.0f : (h > 1.0f ? 1.0f : h);
+/**
+ * Input size of the network of a model
+ */
+static bool sod_model_input_size(model_t *m, int *width, int *height, int *channels) {
+    void *net = m->sod.batch ? (void *)m->sod.batch->net : m->sod.model;
+    return net && sod_cnn_get_network_size(net, width, height, channels) == SOD_OK;
+}
 
-        // Apply threshold
-        if (confidence < m->sod.threshold) {
-            log_info("Detection %d below threshold: %s (%.2f%%) at [%.2f, %.2f, %.2f, %.2f]",
-                    i, label, confidence * 100.0f, x, y, w, h);
-            continue;
-        }
+/**
+ * Check whether a model takes YUV 4:2:0 frames
+ */
+bool sod_model_accepts_yuv420(detection_model_t model) {
+    model_t *m = (model_t *)model;
+    if (!m || strcmp(m->type, MODEL_TYPE_SOD) != 0 || !sod_available) {
+        return false;
+    }
 
-        // Add valid detection to result
-        strncpy(result->detections[valid_count].label, label, MAX_LABEL_LENGTH - 1);
-        result->detections[valid_count].confidence = confidence;
-        result->detections[valid_count].x = x;
-        result->detections[valid_count].y = y;
-        result->detections[valid_count].width = w;
-        result->detections[valid_count].height = h;
+    int width = 0, height = 0, channels = 0;
+    return sod_model_input_size(m, &width, &height, &channels) &&
+           channels == 3 && width > 0 && width <= TENSOR_MAX_WIDTH && height > 0;
+}
 
-        log_info("Valid detection %d: %s (%.2f%%) at [%.2f, %.2f, %.2f, %.2f]",
-                valid_count, label, confidence * 100.0f, x, y, w, h);
+/**
+ * Run detection on a YUV 4:2:0 frame using SOD
+ */
+int detect_with_sod_model_yuv420(detection_model_t model, const yuv420_image_t *frame,
+                                 detection_result_t *result) {
+    if (!model || !frame || !result) {
+        log_error("Invalid parameters for detect_with_sod_model_yuv420");
+        return -1;
+    }
 
-        valid_count++;
+    model_t *m = (model_t *)model;
+    if (!sod_model_accepts_yuv420(model)) {
+        log_error("Model %s does not take YUV frames", m->path);
+        return -1;
     }
 
-    result->count = valid_count;
-    log_info("Detection found %d valid objects out of %d total", valid_count, count);
+    int width = 0, height = 0, channels = 0;
+    sod_model_input_size(m, &width, &height, &channels);
+    float *tensor = reserve_frame_buffer(&m->sod, (size_t)width * height * channels);
+    if (!tensor) {
+        return -1;
+    }
 
-    // Step 7: Free the image data and prepared data
-    log_info("Step 9: Freeing SOD image and prepared data");
-    sod_free_image(img);
-    // Note: The prepared_data is actually part of the SOD image structure, so we don't need to free it separately
-    // It's automatically freed when we call sod_free_image(img)
+    // Resized straight to the network size, so SOD feeds the image as is
+    if (tensor_from_yuv420(frame, tensor, width, height) != 0) {
+        log_error("Failed to convert a %dx%d YUV frame for SOD model %s", frame->width, frame->height, m->path);
+        return -1;
+    }
 
-    return 0;
+    sod_img img = {0};
+    img.w = width;
+    img.h = height;
+    img.c = channels;
+    img.data = tensor;
+    return detect_sod_image(m, img, width, height, result);
 }
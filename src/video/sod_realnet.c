@@ -3,10 +3,15 @@
 #include <string.h>
 #include <stdbool.h>
 #include <dlfcn.h>
+#include <unistd.h>
 
 #include "video/detection.h"
+#include "video/detection_scheduler.h"
 #include "core/logger.h"
 
+// SOD_REALNET_MODEL_THREADS from sod.h: threads the scan of a model is split over
+#define SOD_REALNET_MODEL_THREADS 10
+
 // SOD RealNet function pointers for dynamic loading
 typedef struct {
     void *handle;
@@ -38,9 +43,29 @@ typedef struct sod_realnet_struct sod_realnet;
 // SOD RealNet model structure
 typedef struct {
     void *net;                   // SOD RealNet handle (void* for dynamic loading)
+    unsigned int handle;         // Handle of the cascade within the RealNet
+    int threads;                 // Threads the scan is currently split over
     float threshold;             // Detection threshold
 } sod_realnet_model_t;
 
+/**
+ * Number of threads a scan may use: the cores not taken by the other
+ * detections queued or running, so a lone camera gets every core while a
+ * busy scheduler keeps one scan per worker
+ */
+static int sod_realnet_thread_count(void) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cores <= 1) {
+        return 1;
+    }
+
+    int jobs = detection_scheduler_active_jobs();
+    if (jobs < 1) {
+        jobs = 1;
+    }
+    return jobs < cores ? (int)(cores / jobs) : 1;
+}
+
 /**
  * Initialize SOD RealNet functions
  */
@@ -158,6 +183,8 @@ void* load_sod_realnet_model(const char *model_path, float threshold) {
     
     // Initialize model structure
     model->net = net;
+    model->handle = handle;
+    model->threads = 1;
     model->threshold = threshold;
     
     log_info("SOD RealNet model loaded: %s", model_path);
@@ -211,6 +238,13 @@ int detect_with_sod_realnet(void *model, const unsigned char *frame_data,
     }
     memcpy(blob, frame_data, width * height * channels);
     
+    // Split the scan over the cores the other detections leave idle
+    int threads = sod_realnet_thread_count();
+    if (threads != m->threads &&
+        sod_realnet_funcs.sod_realnet_model_config(m->net, m->handle, SOD_REALNET_MODEL_THREADS, threads) == 0) {
+        m->threads = threads;
+    }
+
     // Run detection
     void *boxes = NULL;
     int box_count = 0;
@@ -0,0 +1,280 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "core/config.h"
+#include "core/logger.h"
+#include "video/stream_arena.h"
+
+#define ARENA_ALIGN 16
+#define ARENA_ROUND(size) (((size) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+#define ARENA_GUARD_SIZE ARENA_ALIGN
+#define ARENA_GUARD_PATTERN 0xFE
+
+#define BLOCK_MAGIC_USED 0x5341424bu  // "SABK"
+#define BLOCK_MAGIC_FREE 0x53414246u  // "SABF"
+
+struct stream_arena;
+
+// Header in front of every block
+typedef struct arena_block {
+    uint32_t magic;
+    uint32_t size;                      // Usable size, rounded to ARENA_ALIGN
+    struct stream_arena *arena;
+    struct arena_block *next_free;
+} arena_block_t;
+
+typedef struct arena_chunk {
+    struct arena_chunk *next;
+    size_t size;                        // Bytes available for blocks
+    size_t used;
+} arena_chunk_t;
+
+typedef struct stream_arena {
+    char name[MAX_STREAM_NAME];
+    arena_chunk_t *chunks;
+    arena_block_t *free_blocks;
+    size_t reserved;                    // Bytes in chunks
+    size_t in_use;                      // Bytes in blocks handed out
+    int blocks;                         // Blocks handed out
+    bool released;                      // Stream removed, destroy with the last block
+    struct stream_arena *next;
+} stream_arena_t;
+
+#define BLOCK_HEADER_SIZE ARENA_ROUND(sizeof(arena_block_t))
+#define CHUNK_HEADER_SIZE ARENA_ROUND(sizeof(arena_chunk_t))
+
+static pthread_mutex_t arena_mutex = PTHREAD_MUTEX_INITIALIZER;
+static stream_arena_t *arenas = NULL;
+
+static inline void *block_data(arena_block_t *block) {
+    return (unsigned char *)block + BLOCK_HEADER_SIZE;
+}
+
+static inline unsigned char *block_guard(arena_block_t *block) {
+    return (unsigned char *)block_data(block) + block->size;
+}
+
+static stream_arena_t *find_arena(const char *stream_name) {
+    for (stream_arena_t *arena = arenas; arena; arena = arena->next) {
+        if (!arena->released && strcmp(arena->name, stream_name) == 0) {
+            return arena;
+        }
+    }
+    return NULL;
+}
+
+static void destroy_arena(stream_arena_t *arena) {
+    stream_arena_t **link = &arenas;
+    while (*link && *link != arena) {
+        link = &(*link)->next;
+    }
+    if (*link) {
+        *link = arena->next;
+    }
+
+    arena_chunk_t *chunk = arena->chunks;
+    while (chunk) {
+        arena_chunk_t *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+
+    log_debug("Released arena of stream %s (%zu bytes)", arena->name, arena->reserved);
+    free(arena);
+}
+
+/**
+ * Carve a block out of the arena's chunks, adding a chunk if none has room
+ */
+static arena_block_t *carve_block(stream_arena_t *arena, size_t size) {
+    size_t needed = BLOCK_HEADER_SIZE + size + ARENA_GUARD_SIZE;
+
+    arena_chunk_t *chunk = arena->chunks;
+    while (chunk && chunk->size - chunk->used < needed) {
+        chunk = chunk->next;
+    }
+
+    if (!chunk) {
+        size_t chunk_size = needed > STREAM_ARENA_CHUNK_SIZE ? needed : STREAM_ARENA_CHUNK_SIZE;
+        chunk = malloc(CHUNK_HEADER_SIZE + chunk_size);
+        if (!chunk) {
+            return NULL;
+        }
+        chunk->size = chunk_size;
+        chunk->used = 0;
+        chunk->next = arena->chunks;
+        arena->chunks = chunk;
+        arena->reserved += chunk_size;
+    }
+
+    arena_block_t *block = (arena_block_t *)((unsigned char *)chunk + CHUNK_HEADER_SIZE + chunk->used);
+    chunk->used += needed;
+
+    block->size = (uint32_t)size;
+    block->arena = arena;
+    memset(block_guard(block), ARENA_GUARD_PATTERN, ARENA_GUARD_SIZE);
+    return block;
+}
+
+void *stream_arena_alloc(const char *stream_name, size_t size) {
+    if (!stream_name || size == 0 || size > UINT32_MAX - ARENA_ALIGN) {
+        return NULL;
+    }
+    size = ARENA_ROUND(size);
+
+    pthread_mutex_lock(&arena_mutex);
+
+    stream_arena_t *arena = find_arena(stream_name);
+    if (!arena) {
+        arena = calloc(1, sizeof(stream_arena_t));
+        if (!arena) {
+            pthread_mutex_unlock(&arena_mutex);
+            log_error("Failed to allocate arena for stream %s", stream_name);
+            return NULL;
+        }
+        strncpy(arena->name, stream_name, MAX_STREAM_NAME - 1);
+        arena->next = arenas;
+        arenas = arena;
+    }
+
+    // Reuse a block of the same size freed by an earlier run of the stream
+    arena_block_t *block = NULL;
+    for (arena_block_t **link = &arena->free_blocks; *link; link = &(*link)->next_free) {
+        if ((*link)->size == size) {
+            block = *link;
+            *link = block->next_free;
+            break;
+        }
+    }
+
+    if (!block) {
+        block = carve_block(arena, size);
+        if (!block) {
+            pthread_mutex_unlock(&arena_mutex);
+            log_error("Failed to allocate %zu bytes from the arena of stream %s", size, stream_name);
+            return NULL;
+        }
+    }
+
+    block->magic = BLOCK_MAGIC_USED;
+    block->next_free = NULL;
+    arena->in_use += size;
+    arena->blocks++;
+
+    pthread_mutex_unlock(&arena_mutex);
+
+    void *data = block_data(block);
+    memset(data, 0, size);
+    return data;
+}
+
+void stream_arena_free(void *ptr) {
+    if (!ptr) {
+        return;
+    }
+
+    arena_block_t *block = (arena_block_t *)((unsigned char *)ptr - BLOCK_HEADER_SIZE);
+
+    pthread_mutex_lock(&arena_mutex);
+
+    if (block->magic == BLOCK_MAGIC_FREE) {
+        pthread_mutex_unlock(&arena_mutex);
+        log_error("Block %p of stream %s freed twice, ignoring", ptr, block->arena->name);
+        return;
+    }
+    if (block->magic != BLOCK_MAGIC_USED) {
+        pthread_mutex_unlock(&arena_mutex);
+        log_error("Block %p is corrupted or not from a stream arena, not freeing it", ptr);
+        return;
+    }
+
+    stream_arena_t *arena = block->arena;
+    const unsigned char *guard = block_guard(block);
+    for (int i = 0; i < ARENA_GUARD_SIZE; i++) {
+        if (guard[i] != ARENA_GUARD_PATTERN) {
+            log_error("Memory corruption detected: guard of block %p of stream %s has been overwritten",
+                      ptr, arena->name);
+            memset(block_guard(block), ARENA_GUARD_PATTERN, ARENA_GUARD_SIZE);
+            break;
+        }
+    }
+
+    block->magic = BLOCK_MAGIC_FREE;
+    block->next_free = arena->free_blocks;
+    arena->free_blocks = block;
+    arena->in_use -= block->size;
+    arena->blocks--;
+
+    if (arena->released && arena->blocks == 0) {
+        destroy_arena(arena);
+    }
+
+    pthread_mutex_unlock(&arena_mutex);
+}
+
+void stream_arena_release(const char *stream_name) {
+    if (!stream_name) {
+        return;
+    }
+
+    pthread_mutex_lock(&arena_mutex);
+
+    stream_arena_t *arena = find_arena(stream_name);
+    if (arena) {
+        arena->released = true;
+        if (arena->blocks == 0) {
+            destroy_arena(arena);
+        } else {
+            log_info("Arena of stream %s still has %d blocks in use, releasing it when they are freed",
+                     stream_name, arena->blocks);
+        }
+    }
+
+    pthread_mutex_unlock(&arena_mutex);
+}
+
+int stream_arena_get_usage(const char *stream_name, size_t *reserved, size_t *in_use) {
+    if (!stream_name) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&arena_mutex);
+
+    stream_arena_t *arena = find_arena(stream_name);
+    if (arena) {
+        if (reserved) {
+            *reserved = arena->reserved;
+        }
+        if (in_use) {
+            *in_use = arena->in_use;
+        }
+    }
+
+    pthread_mutex_unlock(&arena_mutex);
+    return arena ? 0 : -1;
+}
+
+void stream_arena_shutdown(void) {
+    pthread_mutex_lock(&arena_mutex);
+
+    stream_arena_t *arena = arenas;
+    while (arena) {
+        stream_arena_t *next = arena->next;
+        arena->released = true;
+        if (arena->blocks == 0) {
+            destroy_arena(arena);
+        } else {
+            // Leave it to the last free, a thread that has not exited yet may still use it
+            log_warn("Arena of stream %s still has %d blocks in use at shutdown",
+                     arena->name, arena->blocks);
+        }
+        arena = next;
+    }
+
+    pthread_mutex_unlock(&arena_mutex);
+}
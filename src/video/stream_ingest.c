@@ -0,0 +1,1426 @@
+/**
+ * Shared Stream Ingest
+ *
+ * Demuxes each camera input once and fans the packets out to all attached
+ * consumers through per-consumer lock-free rings of packet references.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <errno.h>
+#include <stdarg.h>
+
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/avutil.h>
+#include <libavutil/time.h>
+#include <libavutil/log.h>
+
+#include "core/logger.h"
+#include "core/config.h"
+#include "core/device_profile.h"
+#include "core/shutdown_coordinator.h"
+#include "video/stream_protocol.h"
+#include "video/packet_ring.h"
+#include "video/preroll_buffer.h"
+#include "video/packet_pool.h"
+#include "video/audio_transcode.h"
+#include "video/ffmpeg_utils.h"
+#include "video/stream_ingest.h"
+#include "video/reconnect_manager.h"
+#include "video/thread_utils.h"
+#include "video/hls/hls_viewers.h"
+#include "database/db_streams.h"
+
+// Reconnection backoff
+#define INGEST_BASE_RECONNECT_DELAY_MS 500
+#define INGEST_MAX_RECONNECT_DELAY_MS 30000
+
+// Abort a single blocking read after this long without data
+#define INGEST_READ_TIMEOUT_US (10 * 1000000LL)
+
+// Minimum sane queue depth
+#define INGEST_MIN_QUEUE_DEPTH 16
+
+// Poll interval while waiting for streams, bounds the latency of a missed wakeup
+#define INGEST_STREAMS_POLL_MS 100
+
+// A change in transit time beyond this is a timestamp jump, not jitter
+#define INGEST_MAX_JITTER_STEP_US (10 * 1000000LL)
+
+// Global ingest table, keyed by URL
+static stream_ingest_t *ingests[MAX_STREAMS];
+static pthread_mutex_t ingests_mutex = PTHREAD_MUTEX_INITIALIZER;
+static bool ingest_system_initialized = false;
+
+// Hook run before reconnecting, see stream_ingest_set_reconnect_gate
+static _Atomic(stream_ingest_reconnect_gate_t) reconnect_gate = NULL;
+
+// Per-ingest read deadline used by the interrupt callback (thread-local to the ingest thread)
+static __thread int64_t ingest_read_deadline = 0;
+
+// UDP ingest run by this thread, for counting the packet loss FFmpeg logs
+static __thread stream_ingest_t *udp_log_ingest = NULL;
+
+/**
+ * Take a reference on a streams snapshot
+ */
+static void streams_ref(stream_ingest_streams_t *streams) {
+    if (streams) {
+        atomic_fetch_add(&streams->refcount, 1);
+    }
+}
+
+/**
+ * Drop a reference on a streams snapshot, freeing it with the last reference
+ */
+static void streams_unref(stream_ingest_streams_t *streams) {
+    if (!streams) {
+        return;
+    }
+
+    if (atomic_fetch_sub(&streams->refcount, 1) == 1) {
+        if (streams->fmt_ctx) {
+            // The shadow context was never opened, so avformat_free_context releases
+            // the streams and their codec parameters
+            avformat_free_context(streams->fmt_ctx);
+            streams->fmt_ctx = NULL;
+        }
+        free(streams);
+    }
+}
+
+/**
+ * Release callback for snapshot references still queued in a ring
+ */
+static void release_streams_opaque(void *opaque) {
+    streams_unref((stream_ingest_streams_t *)opaque);
+}
+
+/**
+ * Create an immutable snapshot of the input streams
+ * With an audio transcoder, the audio stream is published as its AAC output.
+ */
+static stream_ingest_streams_t *create_streams_snapshot(AVFormatContext *input_ctx, int generation,
+                                                        const audio_transcoder_t *audio_tc) {
+    stream_ingest_streams_t *streams = calloc(1, sizeof(stream_ingest_streams_t));
+    if (!streams) {
+        log_error("Failed to allocate ingest streams snapshot");
+        return NULL;
+    }
+
+    streams->fmt_ctx = avformat_alloc_context();
+    if (!streams->fmt_ctx) {
+        log_error("Failed to allocate shadow format context for ingest");
+        free(streams);
+        return NULL;
+    }
+
+    int audio_idx = find_audio_stream_index(input_ctx);
+    for (unsigned int i = 0; i < input_ctx->nb_streams; i++) {
+        AVStream *in_stream = input_ctx->streams[i];
+        bool transcoded = audio_tc && (int)i == audio_idx;
+        AVStream *out_stream = avformat_new_stream(streams->fmt_ctx, NULL);
+        if (!out_stream) {
+            log_error("Failed to allocate shadow stream %u for ingest", i);
+            avformat_free_context(streams->fmt_ctx);
+            free(streams);
+            return NULL;
+        }
+
+        const AVCodecParameters *codecpar = transcoded ? audio_transcoder_get_parameters(audio_tc)
+                                                       : in_stream->codecpar;
+        if (avcodec_parameters_copy(out_stream->codecpar, codecpar) < 0) {
+            log_error("Failed to copy codec parameters for shadow stream %u", i);
+            avformat_free_context(streams->fmt_ctx);
+            free(streams);
+            return NULL;
+        }
+
+        out_stream->time_base = transcoded ? audio_transcoder_get_time_base(audio_tc) : in_stream->time_base;
+        out_stream->avg_frame_rate = in_stream->avg_frame_rate;
+        out_stream->r_frame_rate = in_stream->r_frame_rate;
+        out_stream->start_time = in_stream->start_time;
+    }
+
+    streams->video_stream_idx = find_video_stream_index(input_ctx);
+    streams->audio_stream_idx = audio_idx;
+    streams->generation = generation;
+    atomic_init(&streams->refcount, 1);
+
+    return streams;
+}
+
+/**
+ * Add an absolute timeout in milliseconds to the current time
+ */
+static void make_deadline(struct timespec *ts, int timeout_ms) {
+    clock_gettime(CLOCK_REALTIME, ts);
+    ts->tv_sec += timeout_ms / 1000;
+    ts->tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (ts->tv_nsec >= 1000000000L) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+/**
+ * Queue a packet reference for one consumer
+ * Never blocks; a consumer that falls behind loses packets per the ring's drop policy.
+ * Caller must hold the ingest mutex
+ */
+static void enqueue_packet(stream_ingest_consumer_t *consumer, const AVPacket *pkt,
+                           stream_ingest_streams_t *streams, const pipeline_trace_t *trace) {
+    bool is_video = (pkt->stream_index == streams->video_stream_idx);
+
+    if (consumer->video_only && !is_video) {
+        return;
+    }
+
+    // The ring's drop state is only touched by this (producer) thread
+    bool was_dropping = consumer->ring.dropping;
+
+    // Take the snapshot reference first so the consumer never sees an entry without it
+    streams_ref(streams);
+    uint64_t dropped = atomic_load_explicit(&consumer->ring.packets_dropped, memory_order_relaxed);
+    int ret = packet_ring_push(&consumer->ring, pkt, is_video, streams, trace);
+    if (ret != 0) {
+        streams_unref(streams);
+    }
+
+    // A full ring drops a whole GOP at once
+    uint64_t now_dropped = atomic_load_explicit(&consumer->ring.packets_dropped, memory_order_relaxed);
+    if (now_dropped != dropped) {
+        metrics_add(consumer->dropped_metric, now_dropped - dropped);
+        stream_counter_add(&consumer->ingest->counters.drops, now_dropped - dropped);
+    }
+
+    if (!was_dropping && consumer->ring.dropping) {
+        log_warn("Ingest consumer %s for %s is falling behind (%d/%d packets queued), dropping until next keyframe",
+                consumer->name, consumer->ingest->stream_name,
+                packet_ring_count(&consumer->ring), (int)consumer->ring.capacity);
+    } else if (was_dropping && !consumer->ring.dropping) {
+        log_info("Ingest consumer %s for %s resumed on keyframe",
+                consumer->name, consumer->ingest->stream_name);
+    }
+}
+
+/**
+ * Hand a packet to every consumer and to the pre-roll
+ * Takes the ingest mutex
+ */
+static void dispatch_packet(stream_ingest_t *ingest, const AVPacket *pkt, stream_ingest_streams_t *streams,
+                            bool is_video, const pipeline_trace_t *trace) {
+    pthread_mutex_lock(&ingest->mutex);
+    for (int i = 0; i < MAX_INGEST_CONSUMERS; i++) {
+        if (ingest->consumers[i]) {
+            enqueue_packet(ingest->consumers[i], pkt, streams, trace);
+        }
+    }
+    if (is_video) {
+        pipeline_trace_stage(ingest->enqueue_metric, trace);
+    }
+
+    // Keep recent GOPs for event recordings that start with pre-roll,
+    // and the newest one for live consumers
+    if (preroll_buffer_enabled(&ingest->preroll)) {
+        streams_ref(streams);
+        if (preroll_buffer_add(&ingest->preroll, pkt, is_video,
+                               streams->fmt_ctx->streams[pkt->stream_index]->time_base, streams) != 0) {
+            streams_unref(streams);
+        }
+    }
+    pthread_mutex_unlock(&ingest->mutex);
+}
+
+/**
+ * Check whether anything takes the audio of an ingest
+ * Video-only consumers and a pre-roll kept only as GOP cache for live view
+ * never read it, so transcoding can be skipped without them.
+ */
+static bool audio_wanted(stream_ingest_t *ingest) {
+    pthread_mutex_lock(&ingest->mutex);
+    bool wanted = ingest->audio_consumer_count > 0 || ingest->preroll.seconds > 0;
+    pthread_mutex_unlock(&ingest->mutex);
+    return wanted;
+}
+
+/**
+ * Transcode an audio packet and dispatch the AAC packets it completes
+ */
+static void dispatch_transcoded_audio(stream_ingest_t *ingest, audio_transcoder_t *audio_tc, AVPacket *pkt,
+                                      AVPacket *aac_pkt, stream_ingest_streams_t *streams) {
+    int ret = audio_transcoder_send_packet(audio_tc, pkt);
+    if (ret < 0) {
+        log_ffmpeg_error(ret, "Failed to decode audio for transcoding");
+        return;
+    }
+
+    while ((ret = audio_transcoder_receive_packet(audio_tc, aac_pkt)) == 0) {
+        aac_pkt->stream_index = pkt->stream_index;
+        pipeline_trace_t trace;
+        pipeline_trace_stamp(&trace, aac_pkt->pts, false);
+        dispatch_packet(ingest, aac_pkt, streams, false, &trace);
+        av_packet_unref(aac_pkt);
+    }
+
+    if (ret != AVERROR(EAGAIN)) {
+        log_ffmpeg_error(ret, "Failed to encode AAC audio");
+    }
+}
+
+/**
+ * Publish a new streams snapshot and wake consumers waiting for streams
+ */
+static void publish_streams(stream_ingest_t *ingest, stream_ingest_streams_t *streams) {
+    pthread_mutex_lock(&ingest->mutex);
+
+    stream_ingest_streams_t *old = ingest->streams;
+    ingest->streams = streams;
+
+    for (int i = 0; i < MAX_INGEST_CONSUMERS; i++) {
+        stream_ingest_consumer_t *consumer = ingest->consumers[i];
+        if (!consumer) {
+            continue;
+        }
+
+        pthread_mutex_lock(&consumer->mutex);
+        pthread_cond_broadcast(&consumer->cond);
+        pthread_mutex_unlock(&consumer->mutex);
+    }
+
+    pthread_mutex_unlock(&ingest->mutex);
+
+    streams_unref(old);
+}
+
+/**
+ * Wake all consumers of an ingest with EOF
+ */
+static void signal_consumers_eof(stream_ingest_t *ingest) {
+    pthread_mutex_lock(&ingest->mutex);
+    for (int i = 0; i < MAX_INGEST_CONSUMERS; i++) {
+        stream_ingest_consumer_t *consumer = ingest->consumers[i];
+        if (!consumer) {
+            continue;
+        }
+        atomic_store(&consumer->eof, true);
+        packet_ring_close(&consumer->ring);
+
+        pthread_mutex_lock(&consumer->mutex);
+        pthread_cond_broadcast(&consumer->cond);
+        pthread_mutex_unlock(&consumer->mutex);
+    }
+    pthread_mutex_unlock(&ingest->mutex);
+}
+
+/**
+ * FFmpeg interrupt callback so blocking reads end promptly on stop
+ */
+static int ingest_interrupt_callback(void *opaque) {
+    stream_ingest_t *ingest = (stream_ingest_t *)opaque;
+
+    if (!atomic_load(&ingest->running) || is_shutdown_initiated()) {
+        return 1;
+    }
+
+    if (ingest_read_deadline > 0 && av_gettime_relative() > ingest_read_deadline) {
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * FFmpeg log callback picking up RTP packet loss
+ * The RTP demuxer keeps its sequence number statistics to itself and only
+ * reports loss as warnings, which it logs on the thread reading the input.
+ */
+static void ingest_log_callback(void *avcl, int level, const char *fmt, va_list vl) {
+    stream_ingest_t *ingest = udp_log_ingest;
+
+    if (ingest && fmt && level <= AV_LOG_WARNING && strncmp(fmt, "RTP: ", 5) == 0) {
+        uint64_t lost = 0;
+        if (strncmp(fmt, "RTP: missed %d packets", 22) == 0) {
+            va_list args;
+            va_copy(args, vl);
+            int missed = va_arg(args, int);
+            va_end(args);
+            lost = missed > 0 ? (uint64_t)missed : 0;
+        } else if (strncmp(fmt, "RTP: dropping old packet received too late", 42) == 0) {
+            lost = 1;
+        }
+        if (lost > 0) {
+            stream_counter_add(&ingest->counters.lost, lost);
+            metrics_add(ingest->lost_metric, lost);
+        }
+    }
+
+    av_log_default_callback(avcl, level, fmt, vl);
+}
+
+/**
+ * Update the interarrival jitter of RFC 3550 with a video packet
+ * The transit time of a packet is its arrival time less its timestamp, and
+ * the jitter is the smoothed change in transit time from packet to packet.
+ */
+static void update_jitter(stream_ingest_t *ingest, int64_t *prev_transit, const AVPacket *pkt,
+                          AVRational time_base, int64_t now_us) {
+    int64_t ts = pkt->dts != AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
+    if (ts == AV_NOPTS_VALUE) {
+        return;
+    }
+
+    int64_t transit = now_us - av_rescale_q(ts, time_base, AV_TIME_BASE_Q);
+    if (*prev_transit != AV_NOPTS_VALUE) {
+        int64_t d = llabs(transit - *prev_transit);
+        if (d < INGEST_MAX_JITTER_STEP_US) {
+            int64_t jitter = atomic_load_explicit(&ingest->counters.jitter_us, memory_order_relaxed);
+            jitter += (d - jitter) / 16;
+            stream_counter_set(&ingest->counters.jitter_us, jitter);
+            metrics_set(ingest->jitter_metric, (uint64_t)jitter);
+        }
+    }
+    *prev_transit = transit;
+}
+
+/**
+ * Sleep in small steps so a stop request is honored quickly
+ */
+static void ingest_sleep_ms(stream_ingest_t *ingest, int delay_ms) {
+    while (delay_ms > 0 && atomic_load(&ingest->running) && !is_shutdown_initiated()) {
+        int step = delay_ms > 100 ? 100 : delay_ms;
+        av_usleep(step * 1000);
+        delay_ms -= step;
+    }
+}
+
+/**
+ * Calculate reconnection delay with exponential backoff
+ * The reconnect manager stretches it while the camera host is unreachable
+ * and adds jitter, so ingests that lost the same host at the same time do
+ * not all reconnect in the same instant.
+ */
+static int ingest_reconnect_delay(const char *url, int attempt) {
+    if (attempt <= 0) return reconnect_manager_delay(url, INGEST_BASE_RECONNECT_DELAY_MS);
+    if (attempt > 16) attempt = 16;
+
+    int delay = INGEST_BASE_RECONNECT_DELAY_MS * (1 << (attempt - 1));
+    if (delay > INGEST_MAX_RECONNECT_DELAY_MS) {
+        delay = INGEST_MAX_RECONNECT_DELAY_MS;
+    }
+    return reconnect_manager_delay(url, delay);
+}
+
+void stream_ingest_set_reconnect_gate(stream_ingest_reconnect_gate_t gate) {
+    atomic_store(&reconnect_gate, gate);
+}
+
+/**
+ * Ingest thread: open the input once and fan every packet out to the consumers
+ */
+static void *stream_ingest_thread(void *arg) {
+    stream_ingest_t *ingest = (stream_ingest_t *)arg;
+    AVFormatContext *input_ctx = NULL;
+    AVPacket *pkt = NULL;
+    AVPacket *aac_pkt = NULL;
+    audio_transcoder_t *audio_tc = NULL;
+    int attempt = 0;
+    int64_t prev_transit = AV_NOPTS_VALUE;
+
+    char stream_name[MAX_STREAM_NAME];
+    strncpy(stream_name, ingest->stream_name, MAX_STREAM_NAME - 1);
+    stream_name[MAX_STREAM_NAME - 1] = '\0';
+    thread_set_identity(THREAD_CLASS_INGEST, "ingest", stream_name);
+
+    if (ingest->protocol == STREAM_PROTOCOL_UDP) {
+        udp_log_ingest = ingest;
+    }
+
+    log_info("Starting shared ingest thread for stream %s", stream_name);
+
+    pkt = av_packet_alloc();
+    aac_pkt = av_packet_alloc();
+    if (!pkt || !aac_pkt) {
+        log_error("Failed to allocate packet for ingest of stream %s", stream_name);
+        av_packet_free(&pkt);
+        av_packet_free(&aac_pkt);
+        signal_consumers_eof(ingest);
+        return NULL;
+    }
+
+    while (atomic_load(&ingest->running) && !is_shutdown_initiated()) {
+        if (attempt > 0) {
+            int delay_ms = ingest_reconnect_delay(ingest->url, attempt);
+            log_info("Ingest for stream %s reconnecting in %d ms (attempt %d)",
+                    stream_name, delay_ms, attempt + 1);
+            ingest_sleep_ms(ingest, delay_ms);
+            if (!atomic_load(&ingest->running) || is_shutdown_initiated()) {
+                break;
+            }
+
+            stream_ingest_reconnect_gate_t gate = atomic_load(&reconnect_gate);
+            if (gate) {
+                gate(ingest->url, INGEST_MAX_RECONNECT_DELAY_MS);
+                if (!atomic_load(&ingest->running) || is_shutdown_initiated()) {
+                    break;
+                }
+            }
+
+            // One probe per camera host is shared by all of its ingests; once
+            // the host is back they are let through one after another
+            int release_ms = 0;
+            if (!reconnect_manager_probe(ingest->url, &release_ms)) {
+                log_info("Camera host of stream %s is still unreachable", stream_name);
+                attempt++;
+                continue;
+            }
+            if (release_ms > 0) {
+                ingest_sleep_ms(ingest, release_ms);
+                if (!atomic_load(&ingest->running) || is_shutdown_initiated()) {
+                    break;
+                }
+            }
+        }
+
+        int ret = open_input_stream(&input_ctx, ingest->url, ingest->protocol);
+        if (ret < 0 || !input_ctx) {
+            char error_buf[AV_ERROR_MAX_STRING_SIZE] = {0};
+            av_strerror(ret, error_buf, AV_ERROR_MAX_STRING_SIZE);
+            log_error("Ingest failed to open stream %s: %s", stream_name, error_buf);
+            if (input_ctx) {
+                safe_avformat_cleanup(&input_ctx);
+            }
+            attempt++;
+            continue;
+        }
+
+        input_ctx->interrupt_callback.callback = ingest_interrupt_callback;
+        input_ctx->interrupt_callback.opaque = ingest;
+
+        if (find_video_stream_index(input_ctx) < 0) {
+            log_error("Ingest found no video stream in %s", stream_name);
+            safe_avformat_cleanup(&input_ctx);
+            attempt++;
+            continue;
+        }
+
+        pthread_mutex_lock(&ingest->mutex);
+        int generation = ++ingest->generation;
+        pthread_mutex_unlock(&ingest->mutex);
+
+        // G.711 is transcoded to AAC once here for every consumer; if that cannot
+        // be set up, consumers get the camera's audio as before
+        int audio_idx = find_audio_stream_index(input_ctx);
+        if (audio_idx >= 0 && audio_transcode_needed(input_ctx->streams[audio_idx]->codecpar->codec_id)) {
+            audio_tc = audio_transcoder_create(stream_name, input_ctx->streams[audio_idx]->codecpar,
+                                               input_ctx->streams[audio_idx]->time_base);
+        }
+
+        stream_ingest_streams_t *streams = create_streams_snapshot(input_ctx, generation, audio_tc);
+        if (!streams) {
+            audio_transcoder_free(&audio_tc);
+            safe_avformat_cleanup(&input_ctx);
+            attempt++;
+            continue;
+        }
+
+        // Keep our own reference for dispatching while the connection is open
+        streams_ref(streams);
+        publish_streams(ingest, streams);
+
+        log_info("Shared ingest connected to stream %s (generation %d, %u streams)",
+                stream_name, generation, input_ctx->nb_streams);
+
+        // PTS of the new connection start on a new timeline
+        memset(&ingest->demux_clock, 0, sizeof(ingest->demux_clock));
+        prev_transit = AV_NOPTS_VALUE;
+
+        // Packet sizes of a new connection may follow other encoder settings
+        packet_activity_reset(&ingest->activity, av_gettime() / 1000);
+
+        atomic_store(&ingest->connected, 1);
+        if (attempt > 0) {
+            stream_counter_add(&ingest->counters.reconnects, 1);
+            metrics_add(ingest->reconnects_metric, 1);
+        }
+        attempt = 0;
+
+        while (atomic_load(&ingest->running) && !is_shutdown_initiated()) {
+            ingest_read_deadline = av_gettime_relative() + INGEST_READ_TIMEOUT_US;
+            ret = av_read_frame(input_ctx, pkt);
+            ingest_read_deadline = 0;
+
+            if (ret == AVERROR(EAGAIN)) {
+                av_usleep(10000);
+                continue;
+            }
+
+            if (ret < 0) {
+                if (atomic_load(&ingest->running) && !is_shutdown_initiated()) {
+                    char error_buf[AV_ERROR_MAX_STRING_SIZE] = {0};
+                    av_strerror(ret, error_buf, AV_ERROR_MAX_STRING_SIZE);
+                    log_error("Ingest read error on stream %s: %s", stream_name, error_buf);
+                }
+                break;
+            }
+
+            if (pkt->stream_index < 0 || (unsigned int)pkt->stream_index >= input_ctx->nb_streams ||
+                !pkt->data || pkt->size <= 0) {
+                av_packet_unref(pkt);
+                continue;
+            }
+
+            bool is_video = (pkt->stream_index == streams->video_stream_idx);
+            pipeline_trace_t trace;
+            pipeline_trace_stamp(&trace, pkt->pts, is_video);
+            if (is_video && pkt->pts != AV_NOPTS_VALUE) {
+                pipeline_trace_demux(ingest->demux_metric, &ingest->demux_clock, &trace,
+                                     av_rescale_q(pkt->pts, input_ctx->streams[pkt->stream_index]->time_base,
+                                                  AV_TIME_BASE_Q));
+            }
+
+            // Only this thread writes the counters, so no locked or read-modify-write operations
+            int64_t now_ms = av_gettime() / 1000;
+            stream_counter_add(&ingest->counters.packets, 1);
+            stream_counter_add(&ingest->counters.bytes, (uint64_t)pkt->size);
+            stream_counter_set(&ingest->counters.last_packet_ms, now_ms);
+            metrics_add(ingest->bytes_metric, (uint64_t)pkt->size);
+            if (is_video) {
+                metrics_add(ingest->frames_metric, 1);
+                stream_counter_add(&ingest->counters.frames, 1);
+                stream_counter_set(&ingest->counters.last_pts, pkt->pts);
+                stream_counter_set(&ingest->counters.last_dts, pkt->dts);
+                if (pkt->flags & AV_PKT_FLAG_KEY) {
+                    stream_counter_add(&ingest->counters.keyframes, 1);
+                    stream_counter_set(&ingest->counters.last_keyframe_ms, now_ms);
+                } else {
+                    packet_activity_update(&ingest->activity, pkt->size, now_ms);
+                }
+                if (ingest->protocol == STREAM_PROTOCOL_UDP) {
+                    update_jitter(ingest, &prev_transit, pkt, input_ctx->streams[pkt->stream_index]->time_base,
+                                  av_gettime_relative());
+                }
+            }
+
+            if (audio_tc && pkt->stream_index == streams->audio_stream_idx) {
+                if (audio_wanted(ingest)) {
+                    dispatch_transcoded_audio(ingest, audio_tc, pkt, aac_pkt, streams);
+                }
+            } else {
+                dispatch_packet(ingest, pkt, streams, is_video, &trace);
+            }
+
+            av_packet_unref(pkt);
+        }
+
+        atomic_store(&ingest->connected, 0);
+        safe_avformat_cleanup(&input_ctx);
+        audio_transcoder_free(&audio_tc);
+
+        // Buffered pre-roll belongs to this connection's timeline
+        pthread_mutex_lock(&ingest->mutex);
+        preroll_buffer_clear(&ingest->preroll);
+        pthread_mutex_unlock(&ingest->mutex);
+
+        streams_unref(streams);
+
+        // A read error always leads to a backed-off reconnect
+        attempt = 1;
+    }
+
+    av_packet_free(&pkt);
+    av_packet_free(&aac_pkt);
+
+    // Consumers still attached (e.g. during shutdown) must not wait forever
+    signal_consumers_eof(ingest);
+
+    log_info("Shared ingest thread for stream %s exited", stream_name);
+    return NULL;
+}
+
+/**
+ * Free an ingest whose thread has stopped and which has no consumers
+ */
+static void free_ingest(stream_ingest_t *ingest) {
+    preroll_buffer_clear(&ingest->preroll);
+    streams_unref(ingest->streams);
+    ingest->streams = NULL;
+    pthread_mutex_destroy(&ingest->mutex);
+    free(ingest);
+}
+
+/**
+ * Initialize the shared ingest system
+ */
+int init_stream_ingest_system(void) {
+    pthread_mutex_lock(&ingests_mutex);
+    if (!ingest_system_initialized) {
+        memset(ingests, 0, sizeof(ingests));
+        ingest_system_initialized = true;
+        // Passes every message on to FFmpeg's own logging
+        av_log_set_callback(ingest_log_callback);
+    }
+    pthread_mutex_unlock(&ingests_mutex);
+
+    log_info("Shared stream ingest system initialized (%s)",
+            stream_ingest_enabled() ? "enabled" : "disabled");
+    return 0;
+}
+
+/**
+ * Shut down the shared ingest system
+ */
+void shutdown_stream_ingest_system(void) {
+    pthread_mutex_lock(&ingests_mutex);
+
+    // Signal all ingest threads first so they stop in parallel
+    for (int i = 0; i < MAX_STREAMS; i++) {
+        if (ingests[i]) {
+            atomic_store(&ingests[i]->running, 0);
+        }
+    }
+
+    // The ingest threads never take ingests_mutex, so joining here is safe.
+    // Ingests that still have consumers are freed when the last consumer detaches.
+    for (int i = 0; i < MAX_STREAMS; i++) {
+        stream_ingest_t *ingest = ingests[i];
+        if (!ingest) {
+            continue;
+        }
+
+        if (ingest->thread_started) {
+            pthread_join(ingest->thread, NULL);
+            ingest->thread_started = false;
+        }
+
+        if (ingest->consumer_count == 0) {
+            ingests[i] = NULL;
+            free_ingest(ingest);
+        }
+    }
+
+    ingest_system_initialized = false;
+    pthread_mutex_unlock(&ingests_mutex);
+
+    log_info("Shared stream ingest system shut down");
+}
+
+/**
+ * Check whether shared ingest is enabled in the configuration
+ */
+bool stream_ingest_enabled(void) {
+    return g_config.shared_ingest_enabled;
+}
+
+/**
+ * Check whether an ingest URL is the stream's detection sub-stream
+ * Sub-streams are only decoded for detection and are never recorded.
+ */
+static bool is_detection_substream(const stream_config_t *config, const char *url) {
+    return config->detection_url[0] != '\0' &&
+           strcmp(config->detection_url, url) == 0 &&
+           strcmp(config->url, url) != 0;
+}
+
+/**
+ * Get the pre-roll duration configured for an ingest of a stream
+ */
+static int configured_preroll_seconds(const char *stream_name, const char *url) {
+    stream_config_t config;
+    if (get_stream_config_by_name(stream_name, &config) != 0 || is_detection_substream(&config, url)) {
+        return 0;
+    }
+
+    return (config.detection_based_recording && config.pre_detection_buffer > 0) ?
+           config.pre_detection_buffer : 0;
+}
+
+/**
+ * Check whether an ingest of a stream keeps its newest GOP for live consumers
+ * On-demand HLS always needs it, since it attaches whenever a viewer comes, and
+ * so does a recording triggered by detection without a pre-detection buffer.
+ */
+static bool configured_gop_cache(const char *stream_name, const char *url) {
+    stream_config_t config;
+    if (get_stream_config_by_name(stream_name, &config) != 0 || is_detection_substream(&config, url)) {
+        return false;
+    }
+
+    return g_config.ingest_gop_cache || hls_viewers_applies(&config) ||
+           (config.detection_based_recording && config.pre_detection_buffer <= 0);
+}
+
+/**
+ * Queue the ingest's pre-roll packets for a consumer that is not yet attached
+ * Caller must hold the ingest mutex
+ */
+static void seed_consumer_with_preroll(stream_ingest_t *ingest, stream_ingest_consumer_t *consumer,
+                                       bool newest_gop_only) {
+    preroll_buffer_t *preroll = &ingest->preroll;
+    preroll_entry_t *first = newest_gop_only ? preroll_buffer_newest_gop(preroll) : preroll->head;
+    if (!first) {
+        return;
+    }
+
+    int count = 0;
+    for (preroll_entry_t *entry = first; entry; entry = entry->next) {
+        count++;
+    }
+
+    // The ring must hold the whole pre-roll below its drop watermark
+    if ((unsigned int)count * 2 > consumer->ring.capacity) {
+        packet_pool_t *pool = consumer->ring.pool;
+        packet_ring_destroy(&consumer->ring, release_streams_opaque);
+        if (packet_ring_init(&consumer->ring, count * 2, pool) != 0) {
+            log_error("Failed to grow ingest queue for pre-roll of stream %s", ingest->stream_name);
+            return;
+        }
+    }
+
+    int queued = 0;
+    for (preroll_entry_t *entry = first; entry; entry = entry->next) {
+        stream_ingest_streams_t *streams = (stream_ingest_streams_t *)entry->opaque;
+        bool is_video = (entry->pkt->stream_index == streams->video_stream_idx);
+
+        if (consumer->video_only && !is_video) {
+            continue;
+        }
+
+        streams_ref(streams);
+        // Pre-roll is not traced; its age would only measure the buffering
+        if (packet_ring_push(&consumer->ring, entry->pkt, is_video, streams, NULL) != 0) {
+            streams_unref(streams);
+        } else {
+            queued++;
+        }
+    }
+
+    log_info("Queued %d pre-roll packets (%d GOPs) for ingest consumer %s of stream %s",
+            queued, newest_gop_only ? 1 : preroll->gop_count, consumer->name, ingest->stream_name);
+}
+
+// What a new consumer's queue starts with
+typedef enum {
+    INGEST_SEED_NONE = 0,       // Live packets only
+    INGEST_SEED_PREROLL,        // The whole pre-roll
+    INGEST_SEED_NEWEST_GOP      // The newest GOP of the pre-roll or GOP cache
+} ingest_seed_t;
+
+/**
+ * Attach a consumer, optionally seeding its queue with the ingest's pre-roll
+ */
+static stream_ingest_consumer_t *attach_consumer(const char *stream_name, const char *url, int protocol,
+                                                 const char *consumer_name, int queue_depth,
+                                                 bool video_only, ingest_seed_t seed) {
+    if (!stream_name || !url || url[0] == '\0' || !consumer_name) {
+        log_error("Invalid parameters for stream_ingest_attach");
+        return NULL;
+    }
+
+    if (is_shutdown_initiated()) {
+        log_info("Not attaching ingest consumer %s for %s during shutdown", consumer_name, stream_name);
+        return NULL;
+    }
+
+    if (queue_depth <= 0) {
+        queue_depth = device_profile_value(DEVICE_KNOB_INGEST_QUEUE_DEPTH);
+    }
+    if (queue_depth < INGEST_MIN_QUEUE_DEPTH) {
+        queue_depth = INGEST_MIN_QUEUE_DEPTH;
+    }
+
+    stream_ingest_consumer_t *consumer = calloc(1, sizeof(stream_ingest_consumer_t));
+    if (!consumer) {
+        log_error("Failed to allocate ingest consumer for %s", stream_name);
+        return NULL;
+    }
+
+    if (packet_ring_init(&consumer->ring, queue_depth, packet_pool_acquire(stream_name)) != 0) {
+        log_error("Failed to allocate ingest queue for %s", stream_name);
+        free(consumer);
+        return NULL;
+    }
+
+    strncpy(consumer->name, consumer_name, sizeof(consumer->name) - 1);
+    consumer->name[sizeof(consumer->name) - 1] = '\0';
+    consumer->video_only = video_only;
+    consumer->dropped_metric = metrics_counter("lightnvr_ingest_packets_dropped_total",
+                                               "Packets dropped because the consumer fell behind",
+                                               "stream", stream_name, "consumer", consumer_name, NULL);
+    char stage[sizeof(consumer->name) + 8];
+    snprintf(stage, sizeof(stage), "dequeue_%s", consumer_name);
+    consumer->dequeue_metric = pipeline_trace_metric(stream_name, stage);
+    atomic_init(&consumer->eof, false);
+    atomic_init(&consumer->packets_delivered, 0);
+    pthread_mutex_init(&consumer->mutex, NULL);
+    pthread_cond_init(&consumer->cond, NULL);
+
+    pthread_mutex_lock(&ingests_mutex);
+
+    // Find an existing ingest for this URL
+    stream_ingest_t *ingest = NULL;
+    int free_slot = -1;
+    for (int i = 0; i < MAX_STREAMS; i++) {
+        if (ingests[i] && strcmp(ingests[i]->url, url) == 0 && ingests[i]->protocol == protocol) {
+            ingest = ingests[i];
+            break;
+        }
+        if (!ingests[i] && free_slot < 0) {
+            free_slot = i;
+        }
+    }
+
+    if (!ingest) {
+        if (free_slot < 0) {
+            log_error("No free ingest slot for stream %s", stream_name);
+            pthread_mutex_unlock(&ingests_mutex);
+            goto fail;
+        }
+
+        // Aligned so the counters block starts on its own cache line
+        if (posix_memalign((void **)&ingest, 64, sizeof(stream_ingest_t)) != 0) {
+            ingest = NULL;
+        }
+        if (!ingest) {
+            log_error("Failed to allocate ingest for stream %s", stream_name);
+            pthread_mutex_unlock(&ingests_mutex);
+            goto fail;
+        }
+
+        memset(ingest, 0, sizeof(stream_ingest_t));
+        strncpy(ingest->stream_name, stream_name, MAX_STREAM_NAME - 1);
+        ingest->stream_name[MAX_STREAM_NAME - 1] = '\0';
+        strncpy(ingest->url, url, MAX_URL_LENGTH - 1);
+        ingest->url[MAX_URL_LENGTH - 1] = '\0';
+        ingest->protocol = protocol;
+        pthread_mutex_init(&ingest->mutex, NULL);
+        atomic_init(&ingest->running, 0);
+        atomic_init(&ingest->connected, 0);
+        stream_counters_init(&ingest->counters, AV_NOPTS_VALUE);
+        packet_activity_reset(&ingest->activity, av_gettime() / 1000);
+        ingest->frames_metric = metrics_counter("lightnvr_ingest_video_frames_total",
+                                                "Video frames read from the camera",
+                                                "stream", stream_name, NULL);
+        ingest->bytes_metric = metrics_counter("lightnvr_ingest_bytes_total",
+                                               "Bytes read from the camera",
+                                               "stream", stream_name, NULL);
+        ingest->reconnects_metric = metrics_counter("lightnvr_stream_reconnects_total",
+                                                    "Reconnections to the camera",
+                                                    "stream", stream_name, NULL);
+        if (protocol == STREAM_PROTOCOL_UDP) {
+            ingest->lost_metric = metrics_counter("lightnvr_ingest_packets_lost_total",
+                                                  "RTP packets from the camera lost or arriving too late",
+                                                  "stream", stream_name, NULL);
+            ingest->jitter_metric = metrics_gauge("lightnvr_ingest_jitter_microseconds",
+                                                  "Interarrival jitter of video packets from the camera",
+                                                  "stream", stream_name, NULL);
+        }
+        ingest->demux_metric = pipeline_trace_metric(stream_name, PIPELINE_STAGE_DEMUX);
+        ingest->enqueue_metric = pipeline_trace_metric(stream_name, PIPELINE_STAGE_ENQUEUE);
+        preroll_buffer_init(&ingest->preroll, configured_preroll_seconds(stream_name, url), release_streams_opaque,
+                            packet_pool_acquire(stream_name));
+        preroll_buffer_set_gop_cache(&ingest->preroll, configured_gop_cache(stream_name, url));
+
+        ingests[free_slot] = ingest;
+        log_info("Created shared ingest for stream %s", stream_name);
+    }
+
+    pthread_mutex_lock(&ingest->mutex);
+    int slot = -1;
+    for (int i = 0; i < MAX_INGEST_CONSUMERS; i++) {
+        if (!ingest->consumers[i]) {
+            slot = i;
+            break;
+        }
+    }
+
+    if (slot < 0) {
+        pthread_mutex_unlock(&ingest->mutex);
+        pthread_mutex_unlock(&ingests_mutex);
+        log_error("Too many consumers attached to ingest for stream %s", stream_name);
+        goto fail;
+    }
+
+    consumer->ingest = ingest;
+    if (ingest->streams) {
+        consumer->current = ingest->streams;
+        streams_ref(consumer->current);
+    }
+
+    // Seeding under the ingest mutex lines the pre-roll up exactly with the next live packet
+    if (seed != INGEST_SEED_NONE) {
+        seed_consumer_with_preroll(ingest, consumer, seed == INGEST_SEED_NEWEST_GOP);
+    }
+    ingest->consumers[slot] = consumer;
+    ingest->consumer_count++;
+    if (!video_only) {
+        ingest->audio_consumer_count++;
+    }
+    pthread_mutex_unlock(&ingest->mutex);
+
+    if (!ingest->thread_started) {
+        atomic_store(&ingest->running, 1);
+        if (pthread_create_with_stack(&ingest->thread, stream_ingest_thread, ingest,
+                                      STREAM_THREAD_STACK_SIZE, false) != 0) {
+            log_error("Failed to create ingest thread for stream %s", stream_name);
+            atomic_store(&ingest->running, 0);
+
+            pthread_mutex_lock(&ingest->mutex);
+            ingest->consumers[slot] = NULL;
+            ingest->consumer_count--;
+            if (!video_only) {
+                ingest->audio_consumer_count--;
+            }
+            pthread_mutex_unlock(&ingest->mutex);
+            consumer->ingest = NULL;
+            streams_unref(consumer->current);
+            consumer->current = NULL;
+
+            if (ingest->consumer_count == 0) {
+                for (int i = 0; i < MAX_STREAMS; i++) {
+                    if (ingests[i] == ingest) {
+                        ingests[i] = NULL;
+                    }
+                }
+                free_ingest(ingest);
+            }
+            pthread_mutex_unlock(&ingests_mutex);
+            goto fail;
+        }
+        ingest->thread_started = true;
+    }
+
+    log_info("Attached ingest consumer %s to stream %s (%d consumers, queue depth %u)",
+            consumer->name, stream_name, ingest->consumer_count, consumer->ring.capacity);
+
+    pthread_mutex_unlock(&ingests_mutex);
+    return consumer;
+
+fail:
+    pthread_cond_destroy(&consumer->cond);
+    pthread_mutex_destroy(&consumer->mutex);
+    packet_ring_destroy(&consumer->ring, release_streams_opaque);
+    free(consumer);
+    return NULL;
+}
+
+/**
+ * Attach a consumer to the ingest for a URL, starting the ingest if needed
+ */
+stream_ingest_consumer_t *stream_ingest_attach(const char *stream_name, const char *url, int protocol,
+                                               const char *consumer_name, int queue_depth, bool video_only) {
+    return attach_consumer(stream_name, url, protocol, consumer_name, queue_depth, video_only,
+                           INGEST_SEED_NONE);
+}
+
+/**
+ * Attach a consumer whose queue starts with the ingest's pre-detection buffer
+ */
+stream_ingest_consumer_t *stream_ingest_attach_with_preroll(const char *stream_name, const char *url,
+                                                            int protocol, const char *consumer_name,
+                                                            int queue_depth, bool video_only) {
+    return attach_consumer(stream_name, url, protocol, consumer_name, queue_depth, video_only,
+                           INGEST_SEED_PREROLL);
+}
+
+/**
+ * Attach a live consumer whose queue starts with the newest GOP the ingest holds
+ */
+stream_ingest_consumer_t *stream_ingest_attach_with_gop(const char *stream_name, const char *url,
+                                                        int protocol, const char *consumer_name,
+                                                        int queue_depth, bool video_only) {
+    return attach_consumer(stream_name, url, protocol, consumer_name, queue_depth, video_only,
+                           INGEST_SEED_NEWEST_GOP);
+}
+
+/**
+ * Set how many seconds of packets the ingests of a stream keep for pre-roll
+ */
+int stream_ingest_set_preroll(const char *stream_name, const stream_config_t *config, int seconds) {
+    if (!stream_name) {
+        return -1;
+    }
+
+    int ret = -1;
+    pthread_mutex_lock(&ingests_mutex);
+    for (int i = 0; i < MAX_STREAMS; i++) {
+        stream_ingest_t *ingest = ingests[i];
+        if (!ingest || strcmp(ingest->stream_name, stream_name) != 0) {
+            continue;
+        }
+
+        // The detection sub-stream never feeds a recording
+        if (config && is_detection_substream(config, ingest->url)) {
+            continue;
+        }
+
+        pthread_mutex_lock(&ingest->mutex);
+        if (ingest->preroll.seconds != seconds) {
+            log_info("Setting pre-roll for stream %s to %d seconds", stream_name, seconds);
+            preroll_buffer_set_duration(&ingest->preroll, seconds);
+        }
+        pthread_mutex_unlock(&ingest->mutex);
+        ret = 0;
+    }
+    pthread_mutex_unlock(&ingests_mutex);
+
+    return ret;
+}
+
+/**
+ * Detach a consumer and free it
+ */
+void stream_ingest_detach(stream_ingest_consumer_t *consumer) {
+    if (!consumer) {
+        return;
+    }
+
+    stream_ingest_t *ingest_to_stop = NULL;
+    bool join_thread = false;
+
+    pthread_mutex_lock(&ingests_mutex);
+
+    stream_ingest_t *ingest = consumer->ingest;
+    if (ingest) {
+        // Once removed under the ingest mutex the reader no longer touches this consumer
+        pthread_mutex_lock(&ingest->mutex);
+        for (int i = 0; i < MAX_INGEST_CONSUMERS; i++) {
+            if (ingest->consumers[i] == consumer) {
+                ingest->consumers[i] = NULL;
+                ingest->consumer_count--;
+                if (!consumer->video_only) {
+                    ingest->audio_consumer_count--;
+                }
+                break;
+            }
+        }
+        int remaining = ingest->consumer_count;
+        pthread_mutex_unlock(&ingest->mutex);
+
+        log_info("Detached ingest consumer %s from stream %s (%d consumers left)",
+                consumer->name, ingest->stream_name, remaining);
+
+        if (remaining == 0) {
+            for (int i = 0; i < MAX_STREAMS; i++) {
+                if (ingests[i] == ingest) {
+                    ingests[i] = NULL;
+                }
+            }
+            atomic_store(&ingest->running, 0);
+            join_thread = ingest->thread_started;
+            ingest->thread_started = false;
+            ingest_to_stop = ingest;
+        }
+    }
+
+    pthread_mutex_unlock(&ingests_mutex);
+
+    // The ingest thread no longer pushes to this ring, so it can be drained from here
+    packet_ring_destroy(&consumer->ring, release_streams_opaque);
+    streams_unref(consumer->current);
+    streams_unref(consumer->retired);
+    consumer->current = NULL;
+    consumer->retired = NULL;
+
+    pthread_cond_destroy(&consumer->cond);
+    pthread_mutex_destroy(&consumer->mutex);
+    free(consumer);
+
+    // Stop the ingest outside the global lock; its thread may take a moment to leave av_read_frame
+    if (ingest_to_stop) {
+        if (join_thread) {
+            pthread_join(ingest_to_stop->thread, NULL);
+        }
+        log_info("Stopped shared ingest for stream %s", ingest_to_stop->stream_name);
+        free_ingest(ingest_to_stop);
+    }
+}
+
+/**
+ * Adopt the ingest's published snapshot if the consumer has none yet
+ * Called from the consumer thread only.
+ */
+static void adopt_published_streams(stream_ingest_consumer_t *consumer) {
+    stream_ingest_t *ingest = consumer->ingest;
+    if (consumer->current || !ingest) {
+        return;
+    }
+
+    pthread_mutex_lock(&ingest->mutex);
+    if (ingest->streams) {
+        consumer->current = ingest->streams;
+        streams_ref(consumer->current);
+    }
+    pthread_mutex_unlock(&ingest->mutex);
+}
+
+/**
+ * Wait until stream parameters are available for the consumer
+ */
+int stream_ingest_wait_for_streams(stream_ingest_consumer_t *consumer, int timeout_ms) {
+    if (!consumer) {
+        return AVERROR(EINVAL);
+    }
+
+    int64_t deadline = av_gettime_relative() + (int64_t)timeout_ms * 1000;
+
+    while (1) {
+        adopt_published_streams(consumer);
+        if (consumer->current) {
+            return 0;
+        }
+        if (atomic_load(&consumer->eof)) {
+            return AVERROR_EOF;
+        }
+
+        int64_t remaining_us = deadline - av_gettime_relative();
+        if (remaining_us <= 0) {
+            return AVERROR(EAGAIN);
+        }
+
+        // Publication and the wait are not under one lock, so wait in short slices
+        int wait_ms = (int)(remaining_us / 1000) + 1;
+        if (wait_ms > INGEST_STREAMS_POLL_MS) {
+            wait_ms = INGEST_STREAMS_POLL_MS;
+        }
+
+        struct timespec ts;
+        make_deadline(&ts, wait_ms);
+        pthread_mutex_lock(&consumer->mutex);
+        pthread_cond_timedwait(&consumer->cond, &consumer->mutex, &ts);
+        pthread_mutex_unlock(&consumer->mutex);
+    }
+}
+
+/**
+ * Read the next packet for a consumer
+ */
+int stream_ingest_read_packet(stream_ingest_consumer_t *consumer, AVPacket *pkt, int timeout_ms) {
+    if (!consumer || !pkt) {
+        return AVERROR(EINVAL);
+    }
+
+    // Callers were told the previous snapshot is valid until this call
+    if (consumer->retired) {
+        streams_unref(consumer->retired);
+        consumer->retired = NULL;
+    }
+
+    if (!packet_ring_wait(&consumer->ring, timeout_ms)) {
+        return packet_ring_is_closed(&consumer->ring) ? AVERROR_EOF : AVERROR(EAGAIN);
+    }
+
+    packet_ring_entry_t *entry = packet_ring_peek(&consumer->ring);
+    if (!entry) {
+        return AVERROR(EAGAIN);
+    }
+
+    stream_ingest_streams_t *streams = (stream_ingest_streams_t *)entry->opaque;
+    if (streams != consumer->current) {
+        stream_ingest_streams_t *previous = consumer->current;
+        consumer->current = streams;
+        streams_ref(consumer->current);
+
+        if (previous) {
+            // Leave the packet queued so it is returned with the new streams
+            consumer->retired = previous;
+            return STREAM_INGEST_STREAMS_CHANGED;
+        }
+    }
+
+    void *opaque = NULL;
+    packet_ring_pop(&consumer->ring, pkt, &opaque, &consumer->trace);
+    streams_unref((stream_ingest_streams_t *)opaque);
+    atomic_fetch_add(&consumer->packets_delivered, 1);
+
+    if (pkt->stream_index == consumer->current->video_stream_idx) {
+        pipeline_trace_stage(consumer->dequeue_metric, &consumer->trace);
+    }
+
+    return 0;
+}
+
+/**
+ * Get the shadow format context describing the consumer's current streams
+ */
+AVFormatContext *stream_ingest_get_format_context(stream_ingest_consumer_t *consumer) {
+    if (!consumer) {
+        return NULL;
+    }
+
+    adopt_published_streams(consumer);
+    return consumer->current ? consumer->current->fmt_ctx : NULL;
+}
+
+/**
+ * Get the video stream index of the consumer's current streams
+ */
+int stream_ingest_get_video_stream_index(stream_ingest_consumer_t *consumer) {
+    if (!consumer) {
+        return -1;
+    }
+
+    return consumer->current ? consumer->current->video_stream_idx : -1;
+}
+
+/**
+ * Get the audio stream index of the consumer's current streams
+ */
+int stream_ingest_get_audio_stream_index(stream_ingest_consumer_t *consumer) {
+    if (!consumer) {
+        return -1;
+    }
+
+    return consumer->current ? consumer->current->audio_stream_idx : -1;
+}
+
+/**
+ * Check whether the consumer's input showed activity recently
+ */
+bool stream_ingest_active(stream_ingest_consumer_t *consumer, int hold_ms) {
+    if (!consumer || !consumer->ingest) {
+        return true;
+    }
+
+    return packet_activity_recent(&consumer->ingest->activity, av_gettime() / 1000, hold_ms);
+}
+
+/**
+ * Get statistics for the ingest serving a stream
+ */
+int stream_ingest_get_stats(const char *stream_name, stream_ingest_stats_t *stats) {
+    if (!stream_name || !stats) {
+        return -1;
+    }
+
+    int ret = -1;
+    memset(stats, 0, sizeof(stream_ingest_stats_t));
+    stats->last_pts = AV_NOPTS_VALUE;
+    stats->last_dts = AV_NOPTS_VALUE;
+
+    pthread_mutex_lock(&ingests_mutex);
+    for (int i = 0; i < MAX_STREAMS; i++) {
+        stream_ingest_t *ingest = ingests[i];
+        if (!ingest || strcmp(ingest->stream_name, stream_name) != 0) {
+            continue;
+        }
+
+        stream_counters_snapshot_t counters;
+        stream_counters_read(&ingest->counters, &counters);
+
+        // Several ingests may serve one stream name (e.g. camera and go2rtc URLs)
+        stats->packets_read += counters.packets;
+        stats->bytes_read += counters.bytes;
+        stats->frames_read += counters.frames;
+        stats->keyframes_read += counters.keyframes;
+        stats->packets_dropped += counters.drops;
+        stats->reconnects += (int)counters.reconnects;
+        stats->packets_lost += counters.lost;
+        if (counters.jitter_us > stats->jitter_us) {
+            stats->jitter_us = counters.jitter_us;
+        }
+        stats->connected = stats->connected || atomic_load(&ingest->connected);
+
+        time_t last = (time_t)(counters.last_packet_ms / 1000);
+        if (last > stats->last_packet_time) {
+            stats->last_packet_time = last;
+            stats->last_pts = counters.last_pts;
+            stats->last_dts = counters.last_dts;
+        }
+        time_t last_keyframe = (time_t)(counters.last_keyframe_ms / 1000);
+        if (last_keyframe > stats->last_keyframe_time) {
+            stats->last_keyframe_time = last_keyframe;
+        }
+
+        pthread_mutex_lock(&ingest->mutex);
+        stats->consumer_count += ingest->consumer_count;
+        pthread_mutex_unlock(&ingest->mutex);
+
+        ret = 0;
+    }
+    pthread_mutex_unlock(&ingests_mutex);
+
+    return ret;
+}
+
+/**
+ * Add the streams an ingest of a stream delivers to an output context
+ */
+int stream_ingest_add_output_streams(const char *stream_name, AVFormatContext *output_ctx, bool with_audio) {
+    if (!stream_name || !output_ctx) {
+        return -1;
+    }
+
+    stream_config_t config;
+    bool have_config = get_stream_config_by_name(stream_name, &config) == 0;
+
+    // Take a reference so the copy runs without holding the ingest locks
+    stream_ingest_streams_t *streams = NULL;
+    pthread_mutex_lock(&ingests_mutex);
+    for (int i = 0; i < MAX_STREAMS && !streams; i++) {
+        stream_ingest_t *ingest = ingests[i];
+        if (!ingest || strcmp(ingest->stream_name, stream_name) != 0 ||
+            (have_config && is_detection_substream(&config, ingest->url))) {
+            continue;
+        }
+
+        pthread_mutex_lock(&ingest->mutex);
+        if (ingest->streams && ingest->streams->video_stream_idx >= 0) {
+            streams = ingest->streams;
+            streams_ref(streams);
+        }
+        pthread_mutex_unlock(&ingest->mutex);
+    }
+    pthread_mutex_unlock(&ingests_mutex);
+
+    if (!streams) {
+        return -1;
+    }
+
+    int indexes[2] = { streams->video_stream_idx, with_audio ? streams->audio_stream_idx : -1 };
+    int ret = 0;
+    for (int i = 0; i < 2 && ret == 0; i++) {
+        if (indexes[i] < 0) {
+            continue;
+        }
+
+        const AVStream *in_stream = streams->fmt_ctx->streams[indexes[i]];
+        AVStream *out_stream = avformat_new_stream(output_ctx, NULL);
+        if (!out_stream || avcodec_parameters_copy(out_stream->codecpar, in_stream->codecpar) < 0) {
+            ret = -1;
+            break;
+        }
+        out_stream->time_base = in_stream->time_base;
+    }
+
+    streams_unref(streams);
+    return ret;
+}
+
+/**
+ * Get statistics for a consumer
+ */
+int stream_ingest_get_consumer_stats(stream_ingest_consumer_t *consumer, stream_ingest_consumer_stats_t *stats) {
+    if (!consumer || !stats) {
+        return -1;
+    }
+
+    packet_ring_stats_t ring_stats;
+    packet_ring_get_stats(&consumer->ring, &ring_stats);
+
+    memset(stats, 0, sizeof(stream_ingest_consumer_stats_t));
+    stats->packets_delivered = atomic_load(&consumer->packets_delivered);
+    stats->packets_dropped = ring_stats.packets_dropped;
+    stats->gops_dropped = ring_stats.gops_dropped;
+    stats->overruns = ring_stats.overruns;
+    stats->queue_depth = ring_stats.capacity;
+    stats->queue_used = ring_stats.used;
+
+    return 0;
+}
@@ -2,6 +2,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
 #include <unistd.h>
 
 #include "video/stream_manager.h"
@@ -13,6 +15,15 @@
 #include "video/stream_state.h"
 #include "database/db_streams.h"
 #include "video/detection_stream_thread.h"
+#include "video/stream_registry.h"
+#include "video/stream_arena.h"
+
+// Immutable copy of a stream's configuration, see stream_config_acquire()
+typedef struct {
+    stream_config_t config;     // First, so readers' pointers lead back to the snapshot
+    atomic_int refcount;
+    unsigned int generation;    // Generation of the streams table it was read at
+} config_snapshot_t;
 
 // Stream structure
 typedef struct {
@@ -23,12 +34,87 @@ typedef struct {
     bool recording_enabled;
     bool detection_recording_enabled;
     time_t last_detection_time;  // Added for detection-based recording
+
+    // Current configuration snapshot, replaced under mutex, read without it
+    _Atomic(config_snapshot_t *) snapshot;
+    atomic_int acquiring;        // Readers between loading snapshot and taking their reference
 } stream_t;
 
-// Global array of streams
-static stream_t streams[MAX_STREAMS];
+// Global array of streams, indexed by stream registry ID
+// Sized to the registry capacity on first initialization and kept for the
+// lifetime of the process, since handles point into it.
+static stream_t *streams = NULL;
+static int stream_capacity = 0;
 static bool initialized = false;
 
+static void snapshot_unref(config_snapshot_t *snapshot) {
+    if (snapshot && atomic_fetch_sub(&snapshot->refcount, 1) == 1) {
+        free(snapshot);
+    }
+}
+
+/**
+ * Take a reference on the current snapshot of a stream
+ */
+static config_snapshot_t *snapshot_ref(stream_t *s) {
+    atomic_fetch_add(&s->acquiring, 1);
+    config_snapshot_t *snapshot = atomic_load(&s->snapshot);
+    if (snapshot) {
+        atomic_fetch_add(&snapshot->refcount, 1);
+    }
+    atomic_fetch_sub(&s->acquiring, 1);
+    return snapshot;
+}
+
+/**
+ * Replace the snapshot of a stream and drop the stream's reference on the old one
+ * Must be called with the stream mutex held.
+ *
+ * A reader that loaded the old snapshot is counted in acquiring until it holds
+ * its reference, so once acquiring has been seen at zero after the swap, no
+ * reader can still be about to reference the old one.
+ */
+static void publish_snapshot_locked(stream_t *s, config_snapshot_t *snapshot) {
+    config_snapshot_t *old = atomic_exchange(&s->snapshot, snapshot);
+    while (atomic_load(&s->acquiring) > 0) {
+        sched_yield();
+    }
+    snapshot_unref(old);
+}
+
+/**
+ * Read a stream's configuration from the database into a new snapshot
+ * Must be called with the stream mutex held.
+ *
+ * @return 0 on success, -1 if the stream is not in the database
+ */
+static int refresh_snapshot_locked(stream_t *s) {
+    config_snapshot_t *snapshot = malloc(sizeof(config_snapshot_t));
+    if (!snapshot) {
+        return -1;
+    }
+
+    // Taken before reading, so a change made during the read is picked up next time
+    snapshot->generation = stream_configs_generation();
+    if (get_stream_config_by_name(s->config.name, &snapshot->config) != 0) {
+        free(snapshot);
+        return -1;
+    }
+    atomic_init(&snapshot->refcount, 1);
+
+    // Keep the in-memory configuration in sync, as callers of get_stream_config always did
+    memcpy(&s->config, &snapshot->config, sizeof(stream_config_t));
+    publish_snapshot_locked(s, snapshot);
+    return 0;
+}
+
+static void set_status(stream_t *s, stream_status_t status) {
+    if (s->status != status) {
+        s->status = status;
+        stream_state_changed();
+    }
+}
+
 /**
  * Initialize stream manager
  */
@@ -37,34 +123,59 @@ int init_stream_manager(int max_streams) {
         return 0;  // Already initialized
     }
 
+    // Allocate the streams array, one entry per stream ID
+    if (!streams) {
+        if (stream_registry_init(max_streams) != 0) {
+            return -1;
+        }
+
+        stream_capacity = stream_registry_capacity();
+        streams = calloc(stream_capacity, sizeof(stream_t));
+        if (!streams) {
+            log_error("Failed to allocate stream manager for %d streams", stream_capacity);
+            stream_capacity = 0;
+            return -1;
+        }
+    }
+
     // Initialize streams array
-    memset(streams, 0, sizeof(streams));
-    for (int i = 0; i < MAX_STREAMS; i++) {
+    memset(streams, 0, stream_capacity * sizeof(stream_t));
+    for (int i = 0; i < stream_capacity; i++) {
         pthread_mutex_init(&streams[i].mutex, NULL);
-        streams[i].status = STREAM_STATUS_STOPPED;
+        set_status(&streams[i], STREAM_STATUS_STOPPED);
         memset(&streams[i].stats, 0, sizeof(stream_stats_t));
         streams[i].recording_enabled = false;
         streams[i].detection_recording_enabled = false;
     }
 
     // Load stream configurations directly from database
-    stream_config_t db_streams[MAX_STREAMS];
-    int count = get_all_stream_configs(db_streams, MAX_STREAMS);
+    stream_config_t *db_streams = calloc(stream_capacity, sizeof(stream_config_t));
+    int count = db_streams ? get_all_stream_configs(db_streams, stream_capacity) : -1;
 
     if (count > 0) {
-        for (int i = 0; i < count && i < MAX_STREAMS; i++) {
+        for (int i = 0; i < count; i++) {
             if (db_streams[i].name[0] != '\0') {
-                memcpy(&streams[i].config, &db_streams[i], sizeof(stream_config_t));
-                streams[i].recording_enabled = db_streams[i].record;
-                streams[i].detection_recording_enabled = db_streams[i].detection_based_recording;
+                int id = stream_registry_acquire(db_streams[i].name);
+                if (id == STREAM_ID_INVALID) {
+                    continue;
+                }
+                if (streams[id].config.name[0] != '\0') {
+                    // Duplicate name in the database
+                    stream_registry_release(id);
+                    continue;
+                }
+                memcpy(&streams[id].config, &db_streams[i], sizeof(stream_config_t));
+                streams[id].recording_enabled = db_streams[i].record;
+                streams[id].detection_recording_enabled = db_streams[i].detection_based_recording;
             }
         }
     }
+    free(db_streams);
 
     initialized = true;
 
     // Create stream state managers for all existing streams
-    for (int i = 0; i < MAX_STREAMS; i++) {
+    for (int i = 0; i < stream_capacity; i++) {
         if (streams[i].config.name[0] != '\0') {
             stream_state_manager_t *state = get_stream_state_by_name(streams[i].config.name);
             if (!state) {
@@ -145,7 +256,7 @@ void shutdown_stream_manager(void) {
     }
 
     // Stop all streams
-    for (int i = 0; i < MAX_STREAMS; i++) {
+    for (int i = 0; i < stream_capacity; i++) {
         if (streams[i].config.name[0] != '\0' && streams[i].status == STREAM_STATUS_RUNNING) {
             char stream_name[MAX_STREAM_NAME];
             strncpy(stream_name, streams[i].config.name, MAX_STREAM_NAME - 1);
@@ -167,8 +278,13 @@ void shutdown_stream_manager(void) {
                 log_info("Stopped recording for '%s' during shutdown", stream_name);
             }
 
-            streams[i].status = STREAM_STATUS_STOPPED;
+            set_status(&streams[i], STREAM_STATUS_STOPPED);
         }
+
+        // Readers still holding a snapshot keep it until they release it
+        pthread_mutex_lock(&streams[i].mutex);
+        publish_snapshot_locked(&streams[i], NULL);
+        pthread_mutex_unlock(&streams[i].mutex);
     }
 
     initialized = false;
@@ -184,26 +300,29 @@ stream_handle_t get_stream_by_name(const char *name) {
         return NULL;
     }
 
-    for (int i = 0; i < MAX_STREAMS; i++) {
-        if (streams[i].config.name[0] != '\0' && strcmp(streams[i].config.name, name) == 0) {
-            return (stream_handle_t)&streams[i];
-        }
+    int id = stream_registry_lookup(name);
+    if (id != STREAM_ID_INVALID && strcmp(streams[id].config.name, name) == 0) {
+        return (stream_handle_t)&streams[id];
     }
 
     // If stream not found in memory, check if it exists in the database
     stream_config_t db_config;
     if (get_stream_config_by_name(name, &db_config) == 0) {
         // Found in database, add to memory
-        for (int i = 0; i < MAX_STREAMS; i++) {
-            if (streams[i].config.name[0] == '\0') {
-                // Found empty slot
-                memcpy(&streams[i].config, &db_config, sizeof(stream_config_t));
-                streams[i].status = STREAM_STATUS_STOPPED;
-                streams[i].recording_enabled = db_config.record;
-                streams[i].detection_recording_enabled = db_config.detection_based_recording;
-
-                return (stream_handle_t)&streams[i];
+        id = stream_registry_acquire(name);
+        if (id != STREAM_ID_INVALID) {
+            if (streams[id].config.name[0] != '\0') {
+                // Added concurrently
+                stream_registry_release(id);
+                return (stream_handle_t)&streams[id];
             }
+
+            memcpy(&streams[id].config, &db_config, sizeof(stream_config_t));
+            set_status(&streams[id], STREAM_STATUS_STOPPED);
+            streams[id].recording_enabled = db_config.record;
+            streams[id].detection_recording_enabled = db_config.detection_based_recording;
+
+            return (stream_handle_t)&streams[id];
         }
         // No empty slots available
         log_error("No available slots for stream from database: %s", name);
@@ -220,20 +339,53 @@ int get_stream_config(stream_handle_t stream, stream_config_t *config) {
         return -1;
     }
 
+    const stream_config_t *snapshot = stream_config_acquire(stream);
+    if (!snapshot) {
+        return -1;
+    }
+
+    memcpy(config, snapshot, sizeof(stream_config_t));
+    stream_config_release(snapshot);
+    return 0;
+}
+
+/**
+ * Get a reference to the current configuration of a stream
+ */
+const stream_config_t *stream_config_acquire(stream_handle_t stream) {
+    if (!stream) {
+        return NULL;
+    }
+
     stream_t *s = (stream_t *)stream;
+    config_snapshot_t *snapshot = snapshot_ref(s);
+    if (snapshot && snapshot->generation == stream_configs_generation()) {
+        return &snapshot->config;
+    }
+    snapshot_unref(snapshot);
 
-    // Get the configuration directly from the database
-    if (get_stream_config_by_name(s->config.name, config) == 0) {
-        // Update the in-memory configuration to stay in sync
-        pthread_mutex_lock(&s->mutex);
-        memcpy(&s->config, config, sizeof(stream_config_t));
-        pthread_mutex_unlock(&s->mutex);
-        return 0;
+    // The streams table changed since the snapshot was read; one reader reads it again
+    pthread_mutex_lock(&s->mutex);
+    snapshot = atomic_load(&s->snapshot);
+    int ret = 0;
+    if (!snapshot || snapshot->generation != stream_configs_generation()) {
+        ret = refresh_snapshot_locked(s);
     }
+    snapshot = ret == 0 ? snapshot_ref(s) : NULL;
+    if (ret != 0) {
+        log_error("Failed to get stream configuration from database for stream %s", s->config.name);
+    }
+    pthread_mutex_unlock(&s->mutex);
 
-    // Return error if database query fails
-    log_error("Failed to get stream configuration from database for stream %s", s->config.name);
-    return -1;
+    return snapshot ? &snapshot->config : NULL;
+}
+
+/**
+ * Drop a reference taken with stream_config_acquire
+ */
+void stream_config_release(const stream_config_t *config) {
+    // The configuration is the first member of its snapshot
+    snapshot_unref((config_snapshot_t *)config);
 }
 
 /**
@@ -296,6 +448,9 @@ int set_stream_detection_recording(stream_handle_t stream, bool enabled, const c
     bool now_disabled = was_enabled && !enabled;
     // Check if detection was previously disabled and is now being enabled
     bool now_enabled = !was_enabled && enabled;
+    // A new model for a stream that keeps detecting is swapped in place
+    bool model_changed = was_enabled && enabled && model_path && model_path[0] != '\0' &&
+                         strcmp(s->config.detection_model, model_path) != 0;
 
     // Get stream name for potential thread stopping/starting
     char stream_name[MAX_STREAM_NAME];
@@ -340,6 +495,13 @@ int set_stream_detection_recording(stream_handle_t stream, bool enabled, const c
             log_info("Successfully stopped detection thread for stream %s", stream_name);
         }
     }
+    // If only the model changed, load it in the background and swap it in
+    // without stopping the detection thread
+    else if (model_changed && is_stream_detection_thread_running(stream_name)) {
+        if (swap_stream_detection_model(stream_name, config_copy.detection_model) != 0) {
+            log_warn("Failed to swap detection model for stream %s", stream_name);
+        }
+    }
     // If detection was disabled and is now being enabled, start the detection thread
     else if (now_enabled && config_copy.detection_model[0] != '\0') {
         log_info("Detection enabled for stream %s, starting detection thread with model %s",
@@ -427,33 +589,24 @@ stream_handle_t add_stream(const stream_config_t *config) {
         return NULL;
     }
 
-    // Find an empty slot
-    int slot = -1;
-    for (int i = 0; i < MAX_STREAMS; i++) {
-        if (streams[i].config.name[0] == '\0') {
-            slot = i;
-            break;
-        }
-    }
-
-    if (slot == -1) {
+    // The stream ID is the slot in the array
+    int slot = stream_registry_acquire(config->name);
+    if (slot == STREAM_ID_INVALID) {
         log_error("No available slots for new stream");
         return NULL;
     }
 
     // Check if stream with same name already exists
-    for (int i = 0; i < MAX_STREAMS; i++) {
-        if (i != slot && streams[i].config.name[0] != '\0' &&
-            strcmp(streams[i].config.name, config->name) == 0) {
-            log_error("Stream with name '%s' already exists", config->name);
-            return NULL;
-        }
+    if (streams[slot].config.name[0] != '\0') {
+        log_error("Stream with name '%s' already exists", config->name);
+        stream_registry_release(slot);
+        return NULL;
     }
 
     // Initialize the stream
     pthread_mutex_lock(&streams[slot].mutex);
     memcpy(&streams[slot].config, config, sizeof(stream_config_t));
-    streams[slot].status = STREAM_STATUS_STOPPED;
+    set_status(&streams[slot], STREAM_STATUS_STOPPED);
     memset(&streams[slot].stats, 0, sizeof(stream_stats_t));
     streams[slot].recording_enabled = config->record;
     streams[slot].detection_recording_enabled = config->detection_based_recording;
@@ -549,15 +702,8 @@ int remove_stream(stream_handle_t handle) {
     }
 
     // Find the stream in the array
-    int slot = -1;
-    for (int i = 0; i < MAX_STREAMS; i++) {
-        if (&streams[i] == s) {
-            slot = i;
-            break;
-        }
-    }
-
-    if (slot == -1) {
+    int slot = (int)(s - streams);
+    if (slot < 0 || slot >= stream_capacity || s->config.name[0] == '\0') {
         log_error("Stream not found in array");
         return -1;
     }
@@ -597,12 +743,18 @@ int remove_stream(stream_handle_t handle) {
     stream_name_for_cleanup[MAX_STREAM_NAME - 1] = '\0';
 
     memset(&s->config, 0, sizeof(stream_config_t));
-    s->status = STREAM_STATUS_STOPPED;
+    publish_snapshot_locked(s, NULL);
+    set_status(s, STREAM_STATUS_STOPPED);
     memset(&s->stats, 0, sizeof(stream_stats_t));
     s->recording_enabled = false;
     s->detection_recording_enabled = false;
     pthread_mutex_unlock(&s->mutex);
 
+    stream_registry_release(slot);
+
+    // Objects still in use keep the arena alive until they are freed
+    stream_arena_release(stream_name);
+
     log_info("Removed stream '%s' from slot %d", stream_name, slot);
 
     return 0;
@@ -634,11 +786,11 @@ int start_stream(stream_handle_t handle) {
         // Update the old status for backward compatibility
         if (result == 0) {
             pthread_mutex_lock(&s->mutex);
-            s->status = STREAM_STATUS_RUNNING;
+            set_status(s, STREAM_STATUS_RUNNING);
             pthread_mutex_unlock(&s->mutex);
         } else {
             pthread_mutex_lock(&s->mutex);
-            s->status = STREAM_STATUS_ERROR;
+            set_status(s, STREAM_STATUS_ERROR);
             pthread_mutex_unlock(&s->mutex);
         }
 
@@ -658,7 +810,7 @@ int start_stream(stream_handle_t handle) {
     }
 
     // Update status to starting
-    s->status = STREAM_STATUS_STARTING;
+    set_status(s, STREAM_STATUS_STARTING);
 
     // Get streaming_enabled flag
     bool streaming_enabled = s->config.streaming_enabled;
@@ -701,10 +853,10 @@ int start_stream(stream_handle_t handle) {
     // Update status based on results
     pthread_mutex_lock(&s->mutex);
     if (any_component_started) {
-        s->status = STREAM_STATUS_RUNNING;
+        set_status(s, STREAM_STATUS_RUNNING);
         log_info("Stream '%s' is now running", stream_name);
     } else {
-        s->status = STREAM_STATUS_ERROR;
+        set_status(s, STREAM_STATUS_ERROR);
         log_error("Failed to start any components for stream '%s'", stream_name);
         pthread_mutex_unlock(&s->mutex);
         return -1;
@@ -740,7 +892,7 @@ int stop_stream(stream_handle_t handle) {
         // Update the old status for backward compatibility
         if (result == 0) {
             pthread_mutex_lock(&s->mutex);
-            s->status = STREAM_STATUS_STOPPED;
+            set_status(s, STREAM_STATUS_STOPPED);
             pthread_mutex_unlock(&s->mutex);
         }
 
@@ -760,7 +912,7 @@ int stop_stream(stream_handle_t handle) {
     }
 
     // Update status to stopping
-    s->status = STREAM_STATUS_STOPPING;
+    set_status(s, STREAM_STATUS_STOPPING);
 
     // Get streaming_enabled flag
     bool streaming_enabled = s->config.streaming_enabled;
@@ -799,7 +951,7 @@ int stop_stream(stream_handle_t handle) {
 
     // Update status to stopped
     pthread_mutex_lock(&s->mutex);
-    s->status = STREAM_STATUS_STOPPED;
+    set_status(s, STREAM_STATUS_STOPPED);
     pthread_mutex_unlock(&s->mutex);
 
     log_info("Stopped stream '%s'", stream_name);
@@ -810,7 +962,7 @@ int stop_stream(stream_handle_t handle) {
  * Get stream by index
  */
 stream_handle_t get_stream_by_index(int index) {
-    if (index < 0 || index >= MAX_STREAMS || !initialized) {
+    if (index < 0 || index >= stream_capacity || !initialized) {
         return NULL;
     }
 
@@ -831,7 +983,7 @@ int get_active_stream_count(void) {
     }
 
     int count = 0;
-    for (int i = 0; i < MAX_STREAMS; i++) {
+    for (int i = 0; i < stream_capacity; i++) {
         if (streams[i].config.name[0] != '\0' &&
             (streams[i].status == STREAM_STATUS_RUNNING ||
              streams[i].status == STREAM_STATUS_RECONNECTING ||
@@ -852,7 +1004,7 @@ int get_total_stream_count(void) {
     }
 
     int count = 0;
-    for (int i = 0; i < MAX_STREAMS; i++) {
+    for (int i = 0; i < stream_capacity; i++) {
         if (streams[i].config.name[0] != '\0') {
             count++;
         }
@@ -2,6 +2,7 @@
 #include "core/logger.h"
 #include "video/ffmpeg_utils.h"
 #include "video/ffmpeg_leak_detector.h"
+#include "video/dns_cache.h"
 #include <string.h>
 #include <stdio.h>
 #include <ctype.h>
@@ -212,6 +213,30 @@ static bool check_rtsp_stream_exists(const char *url) {
     return true;
 }
 
+/**
+ * Warn once if the kernel caps socket receive buffers below the configured size
+ * Without CAP_NET_ADMIN, SO_RCVBUF is silently limited to net.core.rmem_max.
+ */
+static void warn_if_rcvbuf_capped(long long wanted) {
+    static bool checked = false;
+    if (checked) {
+        return;
+    }
+    checked = true;
+
+    FILE *f = fopen("/proc/sys/net/core/rmem_max", "r");
+    if (!f) {
+        return;
+    }
+    long long rmem_max = 0;
+    if (fscanf(f, "%lld", &rmem_max) == 1 && rmem_max > 0 && rmem_max < wanted) {
+        log_warn("net.core.rmem_max is %lld bytes, below udp_buffer_size of %lld bytes; "
+                 "UDP streams may lose packets (raise it with sysctl -w net.core.rmem_max=%lld)",
+                 rmem_max, wanted, wanted);
+    }
+    fclose(f);
+}
+
 /**
  * Open input stream with appropriate options based on protocol
  * Enhanced with more robust error handling and synchronization for UDP streams
@@ -263,9 +288,14 @@ int open_input_stream(AVFormatContext **input_ctx, const char *url, int protocol
         avformat_close_input(input_ctx);
     }
 
+    // Hand FFmpeg the cached address of the camera so a reconnect does not
+    // wait on the DNS server; logs keep the URL as configured
+    char open_url[1024];
+    dns_cache_resolve_url(local_url, open_url, sizeof(open_url));
+
     // Check if the RTSP stream exists before trying to connect
     if (strncmp(local_url, "rtsp://", 7) == 0) {
-        if (!check_rtsp_stream_exists(local_url)) {
+        if (!check_rtsp_stream_exists(open_url)) {
             log_error("RTSP stream does not exist: %s", local_url);
             return AVERROR(ENOENT); // Return "No such file or directory" error
         }
@@ -299,12 +329,28 @@ int open_input_stream(AVFormatContext **input_ctx, const char *url, int protocol
         log_info("Using UDP protocol for stream URL: %s (multicast: %s)",
                 local_url, is_multicast ? "yes" : "no");
 
-        // UDP-specific options with improved buffering for smoother playback
-        // Increased buffer size to 16MB as recommended for UDP jitter handling
-        av_dict_set(&input_options, "buffer_size", "16777216", 0); // 16MB buffer
+        // Socket receive buffer of the RTP sockets (or of a udp:// input); a
+        // 4K camera overruns the default one while the ingest thread is busy
+        char udp_buffer[32];
+        snprintf(udp_buffer, sizeof(udp_buffer), "%lld", (long long)g_config.udp_buffer_size * 1024);
+        warn_if_rcvbuf_capped((long long)g_config.udp_buffer_size * 1024);
+        av_dict_set(&input_options, "buffer_size", udp_buffer, 0);
+
+        // Packets held to put reordered RTP packets back in sequence
+        if (g_config.udp_reorder_queue_size > 0) {
+            av_dict_set_int(&input_options, "reorder_queue_size", g_config.udp_reorder_queue_size, 0);
+        }
+
+        // For udp:// inputs FFmpeg reads the socket on a thread of its own into
+        // this circular buffer (in 188-byte units); an overrun drops data
+        // instead of ending the stream
+        if (strncmp(local_url, "udp://", 6) == 0) {
+            av_dict_set_int(&input_options, "fifo_size", (int64_t)g_config.udp_fifo_size * 1024 / 188, 0);
+            av_dict_set(&input_options, "overrun_nonfatal", "1", 0);
+        }
+
         // Expanded protocol whitelist to support more UDP variants
         av_dict_set(&input_options, "protocol_whitelist", "file,udp,rtp,rtsp,tcp,https,tls,http", 0);
-        av_dict_set(&input_options, "buffer_size", "8388608", 0); // 8MB buffer
         av_dict_set(&input_options, "max_delay", "1000000", 0); // 1000ms max delay
 
         // Allow port reuse
@@ -320,7 +366,7 @@ int open_input_stream(AVFormatContext **input_ctx, const char *url, int protocol
         av_dict_set(&input_options, "fflags", "genpts+discardcorrupt+nobuffer+flush_packets", 0);
 
         // Set UDP-specific socket options
-        av_dict_set(&input_options, "recv_buffer_size", "16777216", 0); // 16MB socket receive buffer
+        av_dict_set(&input_options, "recv_buffer_size", udp_buffer, 0);
 
         // UDP-specific packet reordering settings
         av_dict_set(&input_options, "max_interleave_delta", "1000000", 0); // 1 second max interleave
@@ -433,7 +479,7 @@ int open_input_stream(AVFormatContext **input_ctx, const char *url, int protocol
     local_ctx = NULL;
 
     // Open the input stream
-    ret = avformat_open_input(&local_ctx, local_url, NULL, &input_options);
+    ret = avformat_open_input(&local_ctx, open_url, NULL, &input_options);
 
     if (ret < 0) {
         char error_buf[AV_ERROR_MAX_STRING_SIZE] = {0};
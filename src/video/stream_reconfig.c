@@ -0,0 +1,298 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+#include "core/logger.h"
+#include "video/stream_reconfig.h"
+#include "video/stream_manager.h"
+#include "video/mp4_recording.h"
+#include "video/hls_recording.h"
+#include "video/detection_stream_thread.h"
+#include "video/hls/hls_directory.h"
+#include "video/hls/hls_api.h"
+#include "video/go2rtc/go2rtc_stream.h"
+#include "video/go2rtc/go2rtc_api.h"
+
+// How long to wait for a stream to stop before restarting it, in 100 ms steps
+#define STREAM_STOP_WAIT_STEPS 50
+
+#define CHANGED(field) (old_config->field != new_config->field)
+#define CHANGED_STR(field) (strcmp(old_config->field, new_config->field) != 0)
+
+unsigned int stream_config_changes(const stream_config_t *old_config, const stream_config_t *new_config) {
+    unsigned int changes = STREAM_CHANGE_NONE;
+
+    if (CHANGED_STR(url) || CHANGED(protocol) || CHANGED(enabled) ||
+        CHANGED_STR(onvif_username) || CHANGED_STR(onvif_password)) {
+        changes |= STREAM_CHANGE_INPUT;
+    }
+
+    if (CHANGED(record) || CHANGED(record_audio) || CHANGED(segment_duration)) {
+        changes |= STREAM_CHANGE_RECORDING;
+    }
+
+    if (CHANGED(streaming_enabled) || CHANGED(hls_segment_format)) {
+        changes |= STREAM_CHANGE_HLS;
+    }
+
+    // The HLS writer makes the recordings of streams that record their segments
+    if (hls_recording_applies(old_config) != hls_recording_applies(new_config) ||
+        (hls_recording_applies(new_config) && CHANGED(segment_duration))) {
+        changes |= STREAM_CHANGE_RECORDING | STREAM_CHANGE_HLS;
+    }
+
+    if (CHANGED(detection_based_recording) || CHANGED_STR(detection_model) || CHANGED_STR(detection_url)) {
+        changes |= STREAM_CHANGE_DETECTION;
+    }
+
+    if (CHANGED(detection_threshold) || CHANGED(detection_interval) || CHANGED(detection_frame_step) ||
+        CHANGED(detection_motion_gate) || CHANGED_STR(detection_zones) || CHANGED_STR(motion_mask) ||
+        CHANGED(pre_detection_buffer) || CHANGED(post_detection_buffer) || CHANGED(priority) ||
+        CHANGED(retention_days) || CHANGED(max_storage_bytes) || CHANGED(retention_class) ||
+        CHANGED(width) || CHANGED(height) || CHANGED(fps) || CHANGED_STR(codec) ||
+        CHANGED_STR(onvif_profile) || CHANGED(onvif_discovery_enabled) || CHANGED(is_onvif)) {
+        changes |= STREAM_CHANGE_LIVE;
+    }
+
+    return changes;
+}
+
+void describe_stream_changes(unsigned int changes, char *buffer, size_t size) {
+    static const struct {
+        stream_change_t change;
+        const char *name;
+    } names[] = {
+        {STREAM_CHANGE_LIVE, "live"},
+        {STREAM_CHANGE_DETECTION, "detection"},
+        {STREAM_CHANGE_RECORDING, "recording"},
+        {STREAM_CHANGE_HLS, "hls"},
+        {STREAM_CHANGE_INPUT, "input"},
+    };
+
+    if (size == 0) {
+        return;
+    }
+
+    size_t len = 0;
+    buffer[0] = '\0';
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if ((changes & names[i].change) && len < size) {
+            int n = snprintf(buffer + len, size - len, "%s%s", len > 0 ? "," : "", names[i].name);
+            len += n > 0 ? (size_t)n : 0;
+        }
+    }
+    if (len == 0) {
+        snprintf(buffer, size, "none");
+    }
+}
+
+static bool is_stream_running(stream_handle_t stream) {
+    stream_status_t status = get_stream_status(stream);
+    return status == STREAM_STATUS_RUNNING || status == STREAM_STATUS_STARTING;
+}
+
+/**
+ * Stop and start the whole stream, for changes to its input
+ */
+static int restart_stream(stream_handle_t stream, const stream_config_t *old_config,
+                          const stream_config_t *new_config) {
+    const char *name = new_config->name;
+    bool url_changed = CHANGED_STR(url);
+    int result = 0;
+
+    // Segments of the old camera must not be mixed with the new one
+    if (url_changed) {
+        log_info("URL changed for stream %s, clearing HLS segments", name);
+        if (clear_stream_hls_segments(name) != 0) {
+            log_warn("Failed to clear HLS segments for stream %s", name);
+        }
+    }
+
+    if (is_stream_running(stream)) {
+        log_info("Stopping stream %s for restart", name);
+        if (stop_stream(stream) != 0) {
+            log_error("Failed to stop stream: %s", name);
+        }
+
+        int timeout = STREAM_STOP_WAIT_STEPS;
+        while (get_stream_status(stream) != STREAM_STATUS_STOPPED && timeout > 0) {
+            usleep(100000); // 100ms
+            timeout--;
+        }
+        if (timeout == 0) {
+            log_warn("Timeout waiting for stream %s to stop, continuing anyway", name);
+        }
+    }
+
+    if (!new_config->enabled) {
+        return 0;
+    }
+
+    log_info("Starting stream %s after configuration update", name);
+    if (start_stream(stream) != 0) {
+        log_error("Failed to restart stream: %s", name);
+        result = -1;
+    }
+
+    // The HLS thread keeps its input open across stop and start, so force it to reconnect
+    if ((url_changed || CHANGED(protocol)) && new_config->streaming_enabled) {
+        log_info("URL or protocol changed for stream %s, force restarting HLS stream thread", name);
+        if (restart_hls_stream(name) != 0) {
+            log_warn("Failed to force restart HLS stream for %s", name);
+            result = -1;
+        }
+    }
+    return result;
+}
+
+/**
+ * Start or stop HLS and MP4 recording of a running stream, leaving the input alone
+ */
+static int restart_consumers(stream_handle_t stream, const stream_config_t *old_config,
+                             const stream_config_t *new_config, unsigned int changes) {
+    const char *name = new_config->name;
+    int result = 0;
+
+    if (!is_stream_running(stream)) {
+        return 0;
+    }
+
+    if (changes & STREAM_CHANGE_HLS) {
+        if (new_config->streaming_enabled && old_config->streaming_enabled) {
+            // Segments of the old format are removed with the old output
+            log_info("Restarting HLS streaming of stream %s for %s segments", name,
+                     hls_segment_format_name(new_config->hls_segment_format));
+            result |= restart_hls_stream(name);
+        } else if (new_config->streaming_enabled) {
+            log_info("Starting HLS streaming for stream %s", name);
+            result |= start_hls_stream(name);
+        } else {
+            log_info("Stopping HLS streaming for stream %s", name);
+            result |= stop_hls_stream(name);
+        }
+    }
+
+    if (changes & STREAM_CHANGE_RECORDING) {
+        if (old_config->record) {
+            log_info("Stopping MP4 recording of stream %s to apply new recording settings", name);
+            if (stop_mp4_recording(name) != 0) {
+                log_warn("Failed to stop MP4 recording for stream %s", name);
+            }
+        }
+        if (new_config->record) {
+            log_info("Starting MP4 recording of stream %s", name);
+            result |= start_mp4_recording(name);
+        }
+    }
+
+    return result != 0 ? -1 : 0;
+}
+
+static int start_detection(const stream_config_t *config) {
+    // Detection reads the stream through go2rtc, so make sure it is registered
+    if (go2rtc_stream_is_ready()) {
+        if (!go2rtc_api_stream_exists(config->name)) {
+            log_info("Registering stream %s with go2rtc after enabling detection", config->name);
+            if (!go2rtc_stream_register(config->name, config->url,
+                                        config->onvif_username[0] != '\0' ? config->onvif_username : NULL,
+                                        config->onvif_password[0] != '\0' ? config->onvif_password : NULL)) {
+                log_warn("Failed to register stream %s with go2rtc", config->name);
+            }
+        }
+    } else {
+        log_warn("go2rtc is not ready, stream %s will not be registered", config->name);
+    }
+
+    char hls_dir[MAX_PATH_LENGTH];
+    snprintf(hls_dir, MAX_PATH_LENGTH, "/var/lib/lightnvr/recordings/hls/%s", config->name);
+
+    if (start_stream_detection_thread(config->name, config->detection_model,
+                                      config->detection_threshold,
+                                      config->detection_interval, hls_dir) != 0) {
+        log_warn("Failed to start detection thread for stream %s", config->name);
+        return -1;
+    }
+    log_info("Started detection thread for stream %s with model %s", config->name, config->detection_model);
+    return 0;
+}
+
+/**
+ * Bring the detection thread in line with the new configuration
+ */
+static int apply_detection(const stream_config_t *old_config, const stream_config_t *new_config,
+                           unsigned int changes) {
+    const char *name = new_config->name;
+    bool should_run = new_config->enabled && new_config->detection_based_recording &&
+                      new_config->detection_model[0] != '\0';
+    bool running = is_stream_detection_thread_running(name);
+
+    // A new model alone is swapped in while the thread keeps detecting with
+    // the old one, instead of restarting the thread around the load; usually
+    // set_stream_detection_recording has already started the swap
+    if (running && should_run && (changes & STREAM_CHANGE_DETECTION) &&
+        old_config->detection_based_recording &&
+        strcmp(old_config->detection_url, new_config->detection_url) == 0 &&
+        strcmp(old_config->detection_model, new_config->detection_model) != 0 &&
+        swap_stream_detection_model(name, new_config->detection_model) == 0) {
+        changes &= ~STREAM_CHANGE_DETECTION;
+    }
+
+    if (running && (!should_run || (changes & STREAM_CHANGE_DETECTION))) {
+        log_info("Stopping detection thread for stream %s", name);
+        if (stop_stream_detection_thread(name) != 0) {
+            log_warn("Failed to stop detection thread for stream %s", name);
+        }
+        running = false;
+    }
+
+    if (should_run && !running) {
+        return start_detection(new_config);
+    }
+
+    if (running && (changes & STREAM_CHANGE_LIVE)) {
+        return update_stream_detection_thread(name, new_config->detection_threshold,
+                                              new_config->detection_interval);
+    }
+
+    if (new_config->detection_based_recording && !should_run) {
+        log_warn("Detection enabled for stream %s but no model specified or stream disabled", name);
+    }
+    return 0;
+}
+
+int apply_stream_config_changes(stream_handle_t stream, const stream_config_t *old_config,
+                                const stream_config_t *new_config, unsigned int changes) {
+    if (!stream || !old_config || !new_config) {
+        return -1;
+    }
+
+    const char *name = new_config->name;
+    int result = 0;
+
+    char description[64];
+    describe_stream_changes(changes, description, sizeof(description));
+    log_info("Applying configuration of stream %s (changes: %s)", name, description);
+
+    // Keep the stream manager's copy in step with the database
+    set_stream_priority(stream, new_config->priority);
+    set_stream_recording(stream, new_config->record);
+    set_stream_streaming_enabled(stream, new_config->streaming_enabled);
+    set_stream_detection_recording(stream, new_config->detection_based_recording, new_config->detection_model);
+    if (set_stream_detection_params(stream, new_config->detection_interval, new_config->detection_threshold,
+                                    new_config->pre_detection_buffer, new_config->post_detection_buffer) != 0) {
+        log_warn("Failed to update detection parameters for stream %s", name);
+    }
+
+    if (changes & STREAM_CHANGE_INPUT) {
+        result |= restart_stream(stream, old_config, new_config);
+    } else if (changes & (STREAM_CHANGE_HLS | STREAM_CHANGE_RECORDING)) {
+        result |= restart_consumers(stream, old_config, new_config, changes);
+    }
+
+    // Also starts a detection thread that should be running but is not
+    result |= apply_detection(old_config, new_config, changes);
+
+    return result != 0 ? -1 : 0;
+}
@@ -0,0 +1,268 @@
+/**
+ * Stream Registry
+ *
+ * Descriptor table sized once to the configured stream capacity, with an
+ * FNV-1a hash index chained through the descriptors. Lookups take the read
+ * lock, so concurrent API requests and stream threads never serialize behind
+ * each other.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "core/logger.h"
+#include "video/stream_registry.h"
+
+typedef struct {
+    char name[MAX_STREAM_NAME];
+    int ref_count;                // 0 when the ID is free
+    int next;                     // Next ID in the same bucket, or STREAM_ID_INVALID
+} stream_descriptor_t;
+
+static stream_descriptor_t *descriptors = NULL;
+static int *buckets = NULL;
+static int capacity = 0;
+static unsigned int bucket_mask = 0;
+static int registered_count = 0;
+static pthread_rwlock_t registry_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+/**
+ * Allocate the descriptor table and the hash index
+ * Must be called with the write lock held.
+ */
+static int init_locked(int max_streams) {
+    if (descriptors) {
+        return 0;
+    }
+
+    if (max_streams <= 0 || max_streams > MAX_STREAMS) {
+        log_warn("Invalid stream registry capacity %d, using %d", max_streams, DEFAULT_MAX_STREAMS);
+        max_streams = DEFAULT_MAX_STREAMS;
+    }
+
+    // Power of two, at least twice the number of IDs to keep chains short
+    unsigned int bucket_count = 1;
+    while (bucket_count < (unsigned int)max_streams * 2) {
+        bucket_count <<= 1;
+    }
+
+    descriptors = calloc(max_streams, sizeof(stream_descriptor_t));
+    buckets = malloc(bucket_count * sizeof(int));
+    if (!descriptors || !buckets) {
+        free(descriptors);
+        free(buckets);
+        descriptors = NULL;
+        buckets = NULL;
+        log_error("Failed to allocate stream registry for %d streams", max_streams);
+        return -1;
+    }
+
+    for (unsigned int i = 0; i < bucket_count; i++) {
+        buckets[i] = STREAM_ID_INVALID;
+    }
+    for (int i = 0; i < max_streams; i++) {
+        descriptors[i].next = STREAM_ID_INVALID;
+    }
+
+    capacity = max_streams;
+    bucket_mask = bucket_count - 1;
+    log_info("Stream registry initialized for %d streams", capacity);
+    return 0;
+}
+
+/**
+ * Initialize the registry lazily from the global configuration
+ */
+static int ensure_initialized(void) {
+    pthread_rwlock_rdlock(&registry_lock);
+    bool ready = descriptors != NULL;
+    pthread_rwlock_unlock(&registry_lock);
+
+    return ready ? 0 : stream_registry_init(g_config.max_streams);
+}
+
+/**
+ * Hash a stream name into a bucket
+ * Must be called with registry_lock held.
+ */
+static unsigned int name_bucket(const char *name) {
+    uint32_t hash = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)name; *p; p++) {
+        hash ^= *p;
+        hash *= 16777619u;
+    }
+    return hash & bucket_mask;
+}
+
+/**
+ * Find the ID of a name
+ * Must be called with registry_lock held.
+ */
+static int find_id(const char *name, unsigned int bucket) {
+    if (!descriptors) {
+        return STREAM_ID_INVALID;
+    }
+
+    for (int id = buckets[bucket]; id != STREAM_ID_INVALID; id = descriptors[id].next) {
+        if (strcmp(descriptors[id].name, name) == 0) {
+            return id;
+        }
+    }
+    return STREAM_ID_INVALID;
+}
+
+/**
+ * Size the registry to the configured number of streams
+ */
+int stream_registry_init(int max_streams) {
+    pthread_rwlock_wrlock(&registry_lock);
+    int ret = init_locked(max_streams);
+    pthread_rwlock_unlock(&registry_lock);
+    return ret;
+}
+
+/**
+ * Get the number of IDs the registry can hand out
+ */
+int stream_registry_capacity(void) {
+    if (ensure_initialized() != 0) {
+        return 0;
+    }
+
+    pthread_rwlock_rdlock(&registry_lock);
+    int result = capacity;
+    pthread_rwlock_unlock(&registry_lock);
+    return result;
+}
+
+/**
+ * Get the ID of a stream, registering the name if needed, and take a reference
+ */
+int stream_registry_acquire(const char *stream_name) {
+    if (!stream_name || stream_name[0] == '\0') {
+        return STREAM_ID_INVALID;
+    }
+
+    if (ensure_initialized() != 0) {
+        return STREAM_ID_INVALID;
+    }
+
+    pthread_rwlock_wrlock(&registry_lock);
+
+    unsigned int bucket = name_bucket(stream_name);
+    int id = find_id(stream_name, bucket);
+    if (id == STREAM_ID_INVALID) {
+        for (int i = 0; i < capacity; i++) {
+            if (descriptors[i].ref_count == 0) {
+                id = i;
+                break;
+            }
+        }
+
+        if (id == STREAM_ID_INVALID) {
+            pthread_rwlock_unlock(&registry_lock);
+            log_error("No free stream ID for stream %s", stream_name);
+            return STREAM_ID_INVALID;
+        }
+
+        strncpy(descriptors[id].name, stream_name, MAX_STREAM_NAME - 1);
+        descriptors[id].name[MAX_STREAM_NAME - 1] = '\0';
+        descriptors[id].next = buckets[bucket];
+        buckets[bucket] = id;
+        registered_count++;
+        log_debug("Registered stream %s with ID %d", stream_name, id);
+    }
+
+    descriptors[id].ref_count++;
+
+    pthread_rwlock_unlock(&registry_lock);
+    return id;
+}
+
+/**
+ * Drop a reference taken with stream_registry_acquire
+ */
+void stream_registry_release(int stream_id) {
+    if (stream_id < 0) {
+        return;
+    }
+
+    pthread_rwlock_wrlock(&registry_lock);
+
+    if (stream_id >= capacity) {
+        pthread_rwlock_unlock(&registry_lock);
+        return;
+    }
+
+    stream_descriptor_t *desc = &descriptors[stream_id];
+    if (desc->ref_count <= 0) {
+        pthread_rwlock_unlock(&registry_lock);
+        log_warn("Releasing stream ID %d which is not in use", stream_id);
+        return;
+    }
+
+    if (--desc->ref_count == 0) {
+        // Unlink from the bucket chain
+        int *link = &buckets[name_bucket(desc->name)];
+        while (*link != STREAM_ID_INVALID && *link != stream_id) {
+            link = &descriptors[*link].next;
+        }
+        if (*link == stream_id) {
+            *link = desc->next;
+        }
+
+        log_debug("Unregistered stream %s (ID %d)", desc->name, stream_id);
+        desc->name[0] = '\0';
+        desc->next = STREAM_ID_INVALID;
+        registered_count--;
+    }
+
+    pthread_rwlock_unlock(&registry_lock);
+}
+
+/**
+ * Get the ID of a registered stream without taking a reference
+ */
+int stream_registry_lookup(const char *stream_name) {
+    if (!stream_name || stream_name[0] == '\0') {
+        return STREAM_ID_INVALID;
+    }
+
+    pthread_rwlock_rdlock(&registry_lock);
+    int id = find_id(stream_name, name_bucket(stream_name));
+    pthread_rwlock_unlock(&registry_lock);
+
+    return id;
+}
+
+/**
+ * Get the name registered for an ID
+ */
+int stream_registry_get_name(int stream_id, char *name, size_t name_size) {
+    if (stream_id < 0 || !name || name_size == 0) {
+        return -1;
+    }
+
+    int ret = -1;
+    pthread_rwlock_rdlock(&registry_lock);
+    if (stream_id < capacity && descriptors[stream_id].ref_count > 0) {
+        strncpy(name, descriptors[stream_id].name, name_size - 1);
+        name[name_size - 1] = '\0';
+        ret = 0;
+    }
+    pthread_rwlock_unlock(&registry_lock);
+
+    return ret;
+}
+
+/**
+ * Get the number of registered streams
+ */
+int stream_registry_count(void) {
+    pthread_rwlock_rdlock(&registry_lock);
+    int count = registered_count;
+    pthread_rwlock_unlock(&registry_lock);
+    return count;
+}
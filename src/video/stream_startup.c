@@ -0,0 +1,261 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "core/logger.h"
+#include "core/shutdown_coordinator.h"
+#include "video/stream_ingest.h"
+#include "video/stream_startup.h"
+#include "video/thread_utils.h"
+
+// Interval at which a worker checks whether its stream has connected
+#define STREAM_STARTUP_POLL_MS 100
+
+// Stream being started, with its index in the configuration
+typedef struct {
+    stream_startup_status_t status;
+    int index;
+} startup_entry_t;
+
+static pthread_mutex_t startup_mutex = PTHREAD_MUTEX_INITIALIZER;
+static startup_entry_t *entries = NULL;
+static int entry_count = 0;
+static int next_entry = 0;
+static int active_workers = 0;
+static bool stop_requested = false;
+
+static pthread_t workers[STREAM_STARTUP_MAX_CONCURRENCY];
+static int worker_count = 0;
+static int startup_concurrency = 0;
+static stream_startup_fn_t start_stream = NULL;
+
+const char *stream_startup_state_name(stream_startup_state_t state) {
+    switch (state) {
+        case STREAM_STARTUP_PENDING:
+            return "pending";
+        case STREAM_STARTUP_STARTING:
+            return "starting";
+        case STREAM_STARTUP_CONNECTING:
+            return "connecting";
+        case STREAM_STARTUP_READY:
+            return "ready";
+        case STREAM_STARTUP_FAILED:
+            return "failed";
+    }
+    return "unknown";
+}
+
+static bool should_stop(void) {
+    pthread_mutex_lock(&startup_mutex);
+    bool stop = stop_requested;
+    pthread_mutex_unlock(&startup_mutex);
+    return stop || is_shutdown_initiated();
+}
+
+static bool is_connected(const char *name) {
+    stream_ingest_stats_t stats;
+    return stream_ingest_get_stats(name, &stats) == 0 && stats.connected;
+}
+
+static void set_state(startup_entry_t *entry, stream_startup_state_t state) {
+    pthread_mutex_lock(&startup_mutex);
+    if (entry->status.state == state) {
+        pthread_mutex_unlock(&startup_mutex);
+        return;
+    }
+    entry->status.state = state;
+    if (state == STREAM_STARTUP_READY || state == STREAM_STARTUP_FAILED) {
+        entry->status.ready_at = time(NULL);
+    }
+    pthread_mutex_unlock(&startup_mutex);
+}
+
+/**
+ * Wait for the shared ingest of a stream to connect
+ * The ingest is created by the first consumer, so it may not exist at first.
+ */
+static bool wait_connected(const char *name) {
+    for (int waited = 0; waited < STREAM_STARTUP_CONNECT_TIMEOUT_MS; waited += STREAM_STARTUP_POLL_MS) {
+        if (is_connected(name)) {
+            return true;
+        }
+        if (should_stop()) {
+            return false;
+        }
+        usleep(STREAM_STARTUP_POLL_MS * 1000);
+    }
+    return is_connected(name);
+}
+
+static void *startup_worker(void *arg) {
+    (void)arg;
+    thread_set_identity(THREAD_CLASS_SERVICE, "startup", NULL);
+
+    while (!should_stop()) {
+        pthread_mutex_lock(&startup_mutex);
+        if (next_entry >= entry_count) {
+            pthread_mutex_unlock(&startup_mutex);
+            break;
+        }
+        startup_entry_t *entry = &entries[next_entry++];
+        entry->status.state = STREAM_STARTUP_STARTING;
+        entry->status.started_at = time(NULL);
+        pthread_mutex_unlock(&startup_mutex);
+
+        const char *name = entry->status.name;
+        log_info("Starting stream %s", name);
+
+        if (start_stream(entry->index) != 0) {
+            log_warn("Failed to start all services for stream %s", name);
+            set_state(entry, STREAM_STARTUP_FAILED);
+            continue;
+        }
+
+        // Without the shared ingest each consumer connects on its own
+        if (!stream_ingest_enabled()) {
+            set_state(entry, STREAM_STARTUP_READY);
+            continue;
+        }
+
+        set_state(entry, STREAM_STARTUP_CONNECTING);
+        if (wait_connected(name)) {
+            set_state(entry, STREAM_STARTUP_READY);
+            log_info("Stream %s is ready", name);
+        } else if (!should_stop()) {
+            // Keep retrying in the background, but let the next stream start
+            log_warn("Stream %s did not connect within %d ms, starting the next stream",
+                     name, STREAM_STARTUP_CONNECT_TIMEOUT_MS);
+        }
+    }
+
+    pthread_mutex_lock(&startup_mutex);
+    if (--active_workers == 0 && !stop_requested) {
+        log_info("Stream startup complete");
+    }
+    pthread_mutex_unlock(&startup_mutex);
+    return NULL;
+}
+
+int stream_startup_begin(const stream_config_t *streams, int count, int concurrency,
+                         stream_startup_fn_t start) {
+    if (!streams || !start || count < 0) {
+        return -1;
+    }
+    if (entries) {
+        log_warn("Stream startup already running");
+        return -1;
+    }
+
+    startup_entry_t *list = calloc(count > 0 ? count : 1, sizeof(startup_entry_t));
+    if (!list) {
+        log_error("Failed to allocate stream startup list");
+        return -1;
+    }
+
+    int enabled = 0;
+    for (int i = 0; i < count; i++) {
+        if (streams[i].name[0] == '\0' || !streams[i].enabled) {
+            continue;
+        }
+        strncpy(list[enabled].status.name, streams[i].name, MAX_STREAM_NAME - 1);
+        list[enabled].status.state = STREAM_STARTUP_PENDING;
+        list[enabled].index = i;
+        enabled++;
+    }
+
+    if (concurrency < 1) {
+        concurrency = 1;
+    } else if (concurrency > STREAM_STARTUP_MAX_CONCURRENCY) {
+        concurrency = STREAM_STARTUP_MAX_CONCURRENCY;
+    }
+    if (concurrency > enabled) {
+        concurrency = enabled;
+    }
+
+    pthread_mutex_lock(&startup_mutex);
+    entries = list;
+    entry_count = enabled;
+    next_entry = 0;
+    stop_requested = false;
+    start_stream = start;
+    active_workers = concurrency;
+    startup_concurrency = concurrency;
+    pthread_mutex_unlock(&startup_mutex);
+
+    log_info("Starting %d streams, %d at a time", enabled, concurrency);
+
+    for (int i = 0; i < concurrency; i++) {
+        if (pthread_create(&workers[worker_count], NULL, startup_worker, NULL) != 0) {
+            log_error("Failed to create stream startup worker");
+            pthread_mutex_lock(&startup_mutex);
+            active_workers -= concurrency - i;
+            pthread_mutex_unlock(&startup_mutex);
+            break;
+        }
+        worker_count++;
+    }
+
+    if (worker_count == 0 && enabled > 0) {
+        // Fall back to starting the streams one after the other here
+        pthread_mutex_lock(&startup_mutex);
+        active_workers = 1;
+        startup_concurrency = 1;
+        pthread_mutex_unlock(&startup_mutex);
+        startup_worker(NULL);
+    }
+
+    return 0;
+}
+
+void stream_startup_shutdown(void) {
+    pthread_mutex_lock(&startup_mutex);
+    stop_requested = true;
+    pthread_mutex_unlock(&startup_mutex);
+
+    for (int i = 0; i < worker_count; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    worker_count = 0;
+
+    pthread_mutex_lock(&startup_mutex);
+    free(entries);
+    entries = NULL;
+    entry_count = 0;
+    next_entry = 0;
+    active_workers = 0;
+    pthread_mutex_unlock(&startup_mutex);
+}
+
+int stream_startup_get_status(stream_startup_status_t *status, int max_count, bool *complete) {
+    pthread_mutex_lock(&startup_mutex);
+
+    int count = 0;
+    for (int i = 0; i < entry_count && count < max_count; i++) {
+        startup_entry_t *entry = &entries[i];
+
+        // Streams that timed out while connecting may have connected since
+        if (entry->status.state == STREAM_STARTUP_CONNECTING && is_connected(entry->status.name)) {
+            entry->status.state = STREAM_STARTUP_READY;
+            entry->status.ready_at = time(NULL);
+        }
+        status[count++] = entry->status;
+    }
+
+    if (complete) {
+        *complete = entries && next_entry >= entry_count && active_workers == 0;
+    }
+
+    pthread_mutex_unlock(&startup_mutex);
+    return count;
+}
+
+int stream_startup_concurrency(void) {
+    pthread_mutex_lock(&startup_mutex);
+    int concurrency = startup_concurrency;
+    pthread_mutex_unlock(&startup_mutex);
+    return concurrency;
+}
@@ -14,6 +14,9 @@
 #include "video/mp4_recording.h"
 #include "video/detection.h"
 #include "video/stream_transcoding.h"
+#include "video/stream_registry.h"
+#include "video/stream_arena.h"
+#include "video/stream_ingest.h"
 
 /**
  * BUGFIX: Modified stop_stream_with_state to always stop HLS streaming and MP4 recording
@@ -22,11 +25,30 @@
  * the stream is stopped, even if the flags were changed before stopping.
  */
 
-// Global array of stream state managers
-static stream_state_manager_t *stream_states[MAX_STREAMS];
+// Global array of stream state managers, indexed by stream registry ID
+static stream_state_manager_t **stream_states = NULL;
+static int state_capacity = 0;
 static pthread_mutex_t states_mutex = PTHREAD_MUTEX_INITIALIZER;
 static bool initialized = false;
 
+// Bumped whenever a stream changes state
+static uint64_t state_version = 0;
+
+void stream_state_changed(void) {
+    __atomic_fetch_add(&state_version, 1, __ATOMIC_RELEASE);
+}
+
+uint64_t get_stream_state_version(void) {
+    return __atomic_load_n(&state_version, __ATOMIC_ACQUIRE);
+}
+
+static void set_state(stream_state_manager_t *state, stream_state_t value) {
+    if (state->state != value) {
+        state->state = value;
+        stream_state_changed();
+    }
+}
+
 /**
  * Initialize the stream state management system
  */
@@ -37,8 +59,25 @@ int init_stream_state_manager(int max_streams) {
 
     pthread_mutex_lock(&states_mutex);
 
+    // Allocate the stream states array, one entry per stream ID
+    if (!stream_states) {
+        if (stream_registry_init(max_streams) != 0) {
+            pthread_mutex_unlock(&states_mutex);
+            return -1;
+        }
+
+        state_capacity = stream_registry_capacity();
+        stream_states = calloc(state_capacity, sizeof(stream_state_manager_t *));
+        if (!stream_states) {
+            state_capacity = 0;
+            pthread_mutex_unlock(&states_mutex);
+            log_error("Failed to allocate stream state manager for %d streams", max_streams);
+            return -1;
+        }
+    }
+
     // Initialize stream states array
-    memset(stream_states, 0, sizeof(stream_states));
+    memset(stream_states, 0, state_capacity * sizeof(stream_state_manager_t *));
 
     initialized = true;
     pthread_mutex_unlock(&states_mutex);
@@ -58,7 +97,7 @@ void shutdown_stream_state_manager(void) {
     pthread_mutex_lock(&states_mutex);
 
     // Stop and clean up all streams
-    for (int i = 0; i < MAX_STREAMS; i++) {
+    for (int i = 0; i < state_capacity; i++) {
         if (stream_states[i]) {
             // Make a local copy of the stream name for logging
             char stream_name[MAX_STREAM_NAME];
@@ -74,9 +113,11 @@ void shutdown_stream_state_manager(void) {
             // Destroy mutex
             pthread_mutex_destroy(&stream_states[i]->mutex);
 
-            // Free the state manager
-            free(stream_states[i]);
+            // Free the state manager and everything else the stream allocated
+            stream_arena_free(stream_states[i]);
             stream_states[i] = NULL;
+            stream_registry_release(i);
+            stream_arena_release(stream_name);
 
             log_info("Cleaned up stream state for '%s' during shutdown", stream_name);
         }
@@ -97,46 +138,38 @@ stream_state_manager_t *create_stream_state(const stream_config_t *config) {
         return NULL;
     }
 
-    pthread_mutex_lock(&states_mutex);
-
-    // Find an empty slot
-    int slot = -1;
-    for (int i = 0; i < MAX_STREAMS; i++) {
-        if (!stream_states[i]) {
-            slot = i;
-            break;
-        }
-    }
-
-    if (slot == -1) {
+    // The stream ID is the slot of the state in the array
+    int slot = stream_registry_acquire(config->name);
+    if (slot == STREAM_ID_INVALID) {
         log_error("No available slots for new stream state");
-        pthread_mutex_unlock(&states_mutex);
         return NULL;
     }
 
+    pthread_mutex_lock(&states_mutex);
+
     // Check if stream with same name already exists
-    for (int i = 0; i < MAX_STREAMS; i++) {
-        if (i != slot && stream_states[i] &&
-            strcmp(stream_states[i]->name, config->name) == 0) {
-            log_error("Stream with name '%s' already exists", config->name);
-            pthread_mutex_unlock(&states_mutex);
-            return NULL;
-        }
+    if (stream_states[slot]) {
+        log_error("Stream with name '%s' already exists", config->name);
+        pthread_mutex_unlock(&states_mutex);
+        stream_registry_release(slot);
+        return NULL;
     }
 
     // Allocate and initialize the state manager
-    stream_state_manager_t *state = calloc(1, sizeof(stream_state_manager_t));
+    stream_state_manager_t *state = stream_arena_alloc(config->name, sizeof(stream_state_manager_t));
     if (!state) {
         log_error("Failed to allocate memory for stream state");
         pthread_mutex_unlock(&states_mutex);
+        stream_registry_release(slot);
         return NULL;
     }
 
     // Initialize mutex
     if (pthread_mutex_init(&state->mutex, NULL) != 0) {
         log_error("Failed to initialize stream state mutex");
-        free(state);
+        stream_arena_free(state);
         pthread_mutex_unlock(&states_mutex);
+        stream_registry_release(slot);
         return NULL;
     }
 
@@ -144,8 +177,9 @@ stream_state_manager_t *create_stream_state(const stream_config_t *config) {
     if (pthread_mutex_init(&state->state_mutex, NULL) != 0) {
         log_error("Failed to initialize stream state transition mutex");
         pthread_mutex_destroy(&state->mutex);
-        free(state);
+        stream_arena_free(state);
         pthread_mutex_unlock(&states_mutex);
+        stream_registry_release(slot);
         return NULL;
     }
 
@@ -155,9 +189,10 @@ stream_state_manager_t *create_stream_state(const stream_config_t *config) {
     // Initialize name
     strncpy(state->name, config->name, MAX_STREAM_NAME - 1);
     state->name[MAX_STREAM_NAME - 1] = '\0';
+    state->stream_id = slot;
 
     // Initialize state
-    state->state = STREAM_STATE_INACTIVE;
+    set_state(state, STREAM_STATE_INACTIVE);
 
     // Initialize features
     state->features.streaming_enabled = config->streaming_enabled;
@@ -174,14 +209,15 @@ stream_state_manager_t *create_stream_state(const stream_config_t *config) {
     state->protocol_state.timeout_ms = 0; // Will be set based on protocol
 
     // Initialize timestamp state
-    state->timestamp_state.last_pts = AV_NOPTS_VALUE;
-    state->timestamp_state.last_dts = AV_NOPTS_VALUE;
-    state->timestamp_state.expected_next_pts = AV_NOPTS_VALUE;
+    atomic_init(&state->timestamp_state.last_pts, AV_NOPTS_VALUE);
+    atomic_init(&state->timestamp_state.last_dts, AV_NOPTS_VALUE);
+    atomic_init(&state->timestamp_state.expected_next_pts, AV_NOPTS_VALUE);
     state->timestamp_state.pts_discontinuity_count = 0;
-    state->timestamp_state.timestamps_initialized = false;
+    atomic_init(&state->timestamp_state.timestamps_initialized, false);
 
     // Initialize stats
-    memset(&state->stats, 0, sizeof(stream_stats_t));
+    atomic_init(&state->errors, 0);
+    atomic_init(&state->reconnects, 0);
 
     // Initialize reference counting
     state->ref_count = 1; // Initial reference for the creator
@@ -215,17 +251,21 @@ stream_state_manager_t *get_stream_state_by_name(const char *name) {
         return NULL;
     }
 
+    int stream_id = stream_registry_lookup(name);
+    if (stream_id == STREAM_ID_INVALID) {
+        return NULL;
+    }
+
     pthread_mutex_lock(&states_mutex);
 
-    for (int i = 0; i < MAX_STREAMS; i++) {
-        if (stream_states[i] && strcmp(stream_states[i]->name, name) == 0) {
-            pthread_mutex_unlock(&states_mutex);
-            return stream_states[i];
-        }
+    // The ID may have been reused for another stream since the lookup
+    stream_state_manager_t *state = stream_states[stream_id];
+    if (state && strcmp(state->name, name) != 0) {
+        state = NULL;
     }
 
     pthread_mutex_unlock(&states_mutex);
-    return NULL;
+    return state;
 }
 
 /**
@@ -461,7 +501,7 @@ int start_stream_with_state(stream_state_manager_t *state) {
     }
 
     // Update state to starting
-    state->state = STREAM_STATE_STARTING;
+    set_state(state, STREAM_STATE_STARTING);
 
     // Get feature flags
     bool streaming_enabled = state->features.streaming_enabled;
@@ -511,10 +551,10 @@ int start_stream_with_state(stream_state_manager_t *state) {
     // Update state based on results
     pthread_mutex_lock(&state->mutex);
     if (any_component_started) {
-        state->state = STREAM_STATE_ACTIVE;
+        set_state(state, STREAM_STATE_ACTIVE);
         log_info("Stream '%s' is now running", state->name);
     } else {
-        state->state = STREAM_STATE_ERROR;
+        set_state(state, STREAM_STATE_ERROR);
         log_error("Failed to start any components for stream '%s'", state->name);
         pthread_mutex_unlock(&state->mutex);
         return -1;
@@ -556,7 +596,7 @@ int stop_stream_with_state(stream_state_manager_t *state, bool wait_for_completi
 
     // Update state to stopping
     stream_state_t old_state = state->state;
-    state->state = STREAM_STATE_STOPPING;
+    set_state(state, STREAM_STATE_STOPPING);
 
     // Get feature flags and stream name while holding the mutex
     bool streaming_enabled = state->features.streaming_enabled;
@@ -604,7 +644,7 @@ int stop_stream_with_state(stream_state_manager_t *state, bool wait_for_completi
 
     // Update state to inactive
     pthread_mutex_lock(&state->state_mutex);
-    state->state = STREAM_STATE_INACTIVE;
+    set_state(state, STREAM_STATE_INACTIVE);
 
     // Re-enable callbacks for future use
     state->callbacks_enabled = true;
@@ -638,9 +678,20 @@ int get_stream_statistics(stream_state_manager_t *state, stream_stats_t *stats)
         return -1;
     }
 
-    pthread_mutex_lock(&state->mutex);
-    memcpy(stats, &state->stats, sizeof(stream_stats_t));
-    pthread_mutex_unlock(&state->mutex);
+    memset(stats, 0, sizeof(stream_stats_t));
+    stats->errors = atomic_load_explicit(&state->errors, memory_order_relaxed);
+    stats->reconnects = atomic_load_explicit(&state->reconnects, memory_order_relaxed);
+
+    // Packet counters are kept by the ingest thread of the stream
+    stream_ingest_stats_t ingest;
+    if (stream_ingest_get_stats(state->name, &ingest) == 0) {
+        stats->bytes_received = ingest.bytes_read;
+        stats->frames_received = ingest.frames_read;
+        stats->frames_dropped = ingest.packets_dropped;
+        stats->packets_lost = ingest.packets_lost;
+        stats->jitter_us = (uint64_t)ingest.jitter_us;
+        stats->last_frame_time = (uint64_t)ingest.last_packet_time;
+    }
 
     return 0;
 }
@@ -656,7 +707,7 @@ int handle_stream_error(stream_state_manager_t *state, int error_code, const cha
     pthread_mutex_lock(&state->mutex);
 
     // Update error statistics
-    state->stats.errors++;
+    atomic_fetch_add_explicit(&state->errors, 1, memory_order_relaxed);
 
     // Log the error
     log_error("Stream '%s' error: %s (code: %d)", state->name, error_message, error_code);
@@ -669,15 +720,15 @@ int handle_stream_error(stream_state_manager_t *state, int error_code, const cha
         should_reconnect = true;
 
         // Update state to reconnecting
-        state->state = STREAM_STATE_RECONNECTING;
+        set_state(state, STREAM_STATE_RECONNECTING);
 
         // Update reconnection statistics
         state->protocol_state.reconnect_attempts++;
         state->protocol_state.last_reconnect_time = time(NULL);
-        state->stats.reconnects++;
+        atomic_fetch_add_explicit(&state->reconnects, 1, memory_order_relaxed);
     } else {
         // If not active, just set to error state
-        state->state = STREAM_STATE_ERROR;
+        set_state(state, STREAM_STATE_ERROR);
     }
 
     pthread_mutex_unlock(&state->mutex);
@@ -707,16 +758,15 @@ int update_stream_timestamps(stream_state_manager_t *state, int64_t pts, int64_t
         return -1;
     }
 
-    pthread_mutex_lock(&state->mutex);
-
-    // Update timestamp state
-    state->timestamp_state.last_pts = pts;
-    state->timestamp_state.last_dts = dts;
+    // Only the packet processing thread writes the timestamp state, so no lock is taken
+    stream_timestamp_state_t *ts = &state->timestamp_state;
+    atomic_store_explicit(&ts->last_pts, pts, memory_order_relaxed);
+    atomic_store_explicit(&ts->last_dts, dts, memory_order_relaxed);
 
     // If timestamps weren't initialized, initialize them now
-    if (!state->timestamp_state.timestamps_initialized) {
-        state->timestamp_state.timestamps_initialized = true;
-        state->timestamp_state.expected_next_pts = pts;
+    if (!atomic_load_explicit(&ts->timestamps_initialized, memory_order_relaxed)) {
+        atomic_store_explicit(&ts->expected_next_pts, pts, memory_order_relaxed);
+        atomic_store_explicit(&ts->timestamps_initialized, true, memory_order_release);
     } else {
         // Calculate expected next PTS based on framerate
         int64_t frame_duration = 0;
@@ -730,11 +780,9 @@ int update_stream_timestamps(stream_state_manager_t *state, int64_t pts, int64_t
             frame_duration = 3000;
         }
 
-        state->timestamp_state.expected_next_pts = pts + frame_duration;
+        atomic_store_explicit(&ts->expected_next_pts, pts + frame_duration, memory_order_relaxed);
     }
 
-    pthread_mutex_unlock(&state->mutex);
-
     return 0;
 }
 
@@ -749,7 +797,7 @@ int get_stream_state_count(void) {
     pthread_mutex_lock(&states_mutex);
 
     int count = 0;
-    for (int i = 0; i < MAX_STREAMS; i++) {
+    for (int i = 0; i < state_capacity; i++) {
         if (stream_states[i]) {
             count++;
         }
@@ -763,7 +811,7 @@ int get_stream_state_count(void) {
  * Get stream state manager by index
  */
 stream_state_manager_t *get_stream_state_by_index(int index) {
-    if (index < 0 || index >= MAX_STREAMS || !initialized) {
+    if (index < 0 || index >= state_capacity || !initialized) {
         return NULL;
     }
 
@@ -786,15 +834,8 @@ int remove_stream_state(stream_state_manager_t *state) {
     pthread_mutex_lock(&states_mutex);
 
     // Find the state in the array
-    int slot = -1;
-    for (int i = 0; i < MAX_STREAMS; i++) {
-        if (stream_states[i] == state) {
-            slot = i;
-            break;
-        }
-    }
-
-    if (slot == -1) {
+    int slot = state->stream_id;
+    if (slot < 0 || slot >= state_capacity || stream_states[slot] != state) {
         pthread_mutex_unlock(&states_mutex);
         log_error("Stream state not found in array");
         return -1;
@@ -834,9 +875,11 @@ int remove_stream_state(stream_state_manager_t *state) {
     pthread_mutex_destroy(&state->mutex);
     pthread_mutex_destroy(&state->state_mutex);
 
-    // Free the state manager
-    free(state);
+    // Free the state manager and everything else the stream allocated
+    stream_arena_free(state);
     stream_states[slot] = NULL;
+    stream_registry_release(slot);
+    stream_arena_release(stream_name);
 
     pthread_mutex_unlock(&states_mutex);
 
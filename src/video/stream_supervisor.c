@@ -0,0 +1,425 @@
+/**
+ * Stream pipeline supervisor
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "core/config.h"
+#include "core/logger.h"
+#include "video/stream_supervisor.h"
+#include "video/thread_utils.h"
+
+// Stages supervised at once
+#define SUPERVISOR_MAX_STAGES (MAX_STREAMS * 2)
+
+// Timer wheel of WHEEL_SLOTS ticks; a deadline further out than one turn of
+// the wheel is passed over until its turn comes
+#define WHEEL_SLOTS 64
+#define WHEEL_TICK_MS 250
+
+// Delay before a stage that stalls again after a restart may be restarted
+// again, doubled with every further restart
+#define BACKOFF_INITIAL_MS 10000
+#define BACKOFF_MAX_MS 300000
+
+// Running this long after a restart forgets the backoff
+#define STABLE_PERIOD_MS 120000
+
+struct supervised {
+    char stream_name[MAX_STREAM_NAME];
+    char stage[16];
+    atomic_int_fast64_t last_beat_ms;
+    // The rest is under supervisor.mutex
+    bool used;
+    bool active;                    // Registered and not stopped on purpose
+    bool stalled;                   // Reported by supervisor_report_stall
+    int timeout_ms;
+    supervisor_restart_fn restart;
+    int restarts;                   // Restarts since the stage last ran stably
+    int64_t last_restart_ms;
+    int64_t not_before_ms;          // No restart before this, for the backoff
+    int64_t expires_ms;             // When the wheel looks at the stage again
+    bool in_wheel;
+    int slot;
+    struct supervised *wheel_next;
+};
+
+static struct {
+    pthread_t thread;
+    bool running;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;            // Signaled on stop and when a deadline moves earlier
+    supervised_t stages[SUPERVISOR_MAX_STAGES];
+    supervised_t *wheel[WHEEL_SLOTS];
+    int64_t tick;                   // Next tick of the wheel to process
+} supervisor = {
+    .running = false,
+    .mutex = PTHREAD_MUTEX_INITIALIZER
+};
+
+static int64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * Take a stage off the wheel
+ * Must be called with the supervisor mutex held.
+ */
+static void wheel_remove(supervised_t *s) {
+    if (!s->in_wheel) {
+        return;
+    }
+    supervised_t **link = &supervisor.wheel[s->slot];
+    while (*link && *link != s) {
+        link = &(*link)->wheel_next;
+    }
+    if (*link) {
+        *link = s->wheel_next;
+    }
+    s->wheel_next = NULL;
+    s->in_wheel = false;
+}
+
+/**
+ * Put a stage on the wheel at a time
+ * A time in a tick already processed goes in the next tick.
+ * Must be called with the supervisor mutex held.
+ */
+static void wheel_insert(supervised_t *s, int64_t expires_ms) {
+    wheel_remove(s);
+
+    int64_t tick = expires_ms / WHEEL_TICK_MS;
+    if (tick < supervisor.tick) {
+        tick = supervisor.tick;
+    }
+    s->expires_ms = expires_ms;
+    s->slot = (int)(tick % WHEEL_SLOTS);
+    s->wheel_next = supervisor.wheel[s->slot];
+    supervisor.wheel[s->slot] = s;
+    s->in_wheel = true;
+}
+
+/**
+ * Get the time of the first tick with a stage on it, or -1 if the wheel is empty
+ */
+static int64_t next_wake_ms(void) {
+    for (int i = 0; i < WHEEL_SLOTS; i++) {
+        if (supervisor.wheel[(supervisor.tick + i) % WHEEL_SLOTS]) {
+            return (supervisor.tick + i) * WHEEL_TICK_MS;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Look at a stage whose time on the wheel has come
+ *
+ * @return true if the stage has to be restarted
+ */
+static bool check_stage(supervised_t *s, int64_t now) {
+    // Not its turn of the wheel yet
+    if (s->expires_ms > now) {
+        wheel_insert(s, s->expires_ms);
+        return false;
+    }
+
+    // Beats only move the deadline here, so they never touch the wheel
+    int64_t deadline = atomic_load(&s->last_beat_ms) + s->timeout_ms;
+    if (!s->stalled && deadline > now) {
+        if (s->restarts > 0 && now - s->last_restart_ms >= STABLE_PERIOD_MS) {
+            log_info("Stage %s of stream %s runs stably again", s->stage, s->stream_name);
+            s->restarts = 0;
+        }
+        wheel_insert(s, deadline);
+        return false;
+    }
+
+    if (now < s->not_before_ms) {
+        wheel_insert(s, s->not_before_ms);
+        return false;
+    }
+
+    s->stalled = false;
+    return true;
+}
+
+/**
+ * Process the ticks of the wheel up to now
+ * Must be called with the supervisor mutex held.
+ *
+ * @return Number of stages put in due
+ */
+static int process_wheel(int64_t now, supervised_t **due) {
+    int count = 0;
+    int64_t now_tick = now / WHEEL_TICK_MS;
+
+    // After a long sleep one turn visits every slot
+    for (int steps = 0; supervisor.tick <= now_tick && steps < WHEEL_SLOTS; steps++) {
+        int slot = (int)(supervisor.tick % WHEEL_SLOTS);
+        supervisor.tick++;
+
+        supervised_t *list = supervisor.wheel[slot];
+        supervisor.wheel[slot] = NULL;
+        while (list) {
+            supervised_t *s = list;
+            list = s->wheel_next;
+            s->wheel_next = NULL;
+            s->in_wheel = false;
+
+            if (s->active && check_stage(s, now)) {
+                due[count++] = s;
+            }
+        }
+    }
+    if (supervisor.tick <= now_tick) {
+        supervisor.tick = now_tick + 1;
+    }
+
+    return count;
+}
+
+/**
+ * Restart a stalled stage
+ * Must be called with the supervisor mutex held, which is released while the
+ * restart function runs.
+ */
+static void restart_stage(supervised_t *s, int64_t now) {
+    char stream_name[MAX_STREAM_NAME];
+    char stage[sizeof(s->stage)];
+    memcpy(stream_name, s->stream_name, sizeof(stream_name));
+    memcpy(stage, s->stage, sizeof(stage));
+    supervisor_restart_fn restart = s->restart;
+    int64_t silent_ms = now - atomic_load(&s->last_beat_ms);
+
+    s->restarts++;
+    s->last_restart_ms = now;
+    int shift = s->restarts - 1 < 5 ? s->restarts - 1 : 5;
+    int64_t backoff = (int64_t)BACKOFF_INITIAL_MS << shift;
+    if (backoff > BACKOFF_MAX_MS) {
+        backoff = BACKOFF_MAX_MS;
+    }
+    s->not_before_ms = now + backoff;
+
+    // The restarted stage gets a full timeout to beat again
+    atomic_store(&s->last_beat_ms, now);
+    wheel_insert(s, now + s->timeout_ms);
+
+    if (!restart) {
+        log_warn("Stage %s of stream %s has made no progress for %lld ms",
+                stage, stream_name, (long long)silent_ms);
+        return;
+    }
+
+    log_warn("Stage %s of stream %s has made no progress for %lld ms, restarting it "
+            "(restart %d, next one no sooner than %lld s)",
+            stage, stream_name, (long long)silent_ms, s->restarts, (long long)(backoff / 1000));
+
+    pthread_mutex_unlock(&supervisor.mutex);
+    int result = restart(stream_name);
+    pthread_mutex_lock(&supervisor.mutex);
+
+    // The slot may have been taken over while the mutex was released
+    if (!s->used || strcmp(s->stream_name, stream_name) != 0 || strcmp(s->stage, stage) != 0) {
+        return;
+    }
+
+    if (result != 0) {
+        log_info("Stage %s of stream %s is no longer supervised", stage, stream_name);
+        s->active = false;
+        wheel_remove(s);
+    } else if (!s->active) {
+        // Stopped but not started again; tried again after the backoff
+        s->active = true;
+        atomic_store(&s->last_beat_ms, now_ms());
+        wheel_insert(s, s->not_before_ms);
+    }
+}
+
+static void *supervisor_thread(void *arg) {
+    (void)arg;
+    thread_set_identity(THREAD_CLASS_SERVICE, "supervisor", NULL);
+
+    supervised_t *due[SUPERVISOR_MAX_STAGES];
+
+    pthread_mutex_lock(&supervisor.mutex);
+    while (supervisor.running) {
+        int64_t now = now_ms();
+        int count = process_wheel(now, due);
+        for (int i = 0; i < count && supervisor.running; i++) {
+            // An earlier restart may have stopped this stage for good
+            if (due[i]->active) {
+                restart_stage(due[i], now);
+            }
+        }
+        if (!supervisor.running) {
+            break;
+        }
+
+        int64_t wake = next_wake_ms();
+        if (wake < 0) {
+            pthread_cond_wait(&supervisor.cond, &supervisor.mutex);
+        } else if (wake > now_ms()) {
+            struct timespec ts = {
+                .tv_sec = wake / 1000,
+                .tv_nsec = (wake % 1000) * 1000000
+            };
+            pthread_cond_timedwait(&supervisor.cond, &supervisor.mutex, &ts);
+        }
+    }
+    pthread_mutex_unlock(&supervisor.mutex);
+
+    return NULL;
+}
+
+int start_stream_supervisor(void) {
+    pthread_mutex_lock(&supervisor.mutex);
+    if (supervisor.running) {
+        pthread_mutex_unlock(&supervisor.mutex);
+        return 0;
+    }
+
+    pthread_condattr_t cond_attr;
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&supervisor.cond, &cond_attr);
+    pthread_condattr_destroy(&cond_attr);
+
+    supervisor.tick = now_ms() / WHEEL_TICK_MS;
+    supervisor.running = true;
+    if (pthread_create(&supervisor.thread, NULL, supervisor_thread, NULL) != 0) {
+        log_error("Failed to start stream supervisor thread");
+        supervisor.running = false;
+        pthread_cond_destroy(&supervisor.cond);
+        pthread_mutex_unlock(&supervisor.mutex);
+        return -1;
+    }
+    pthread_mutex_unlock(&supervisor.mutex);
+
+    log_info("Stream supervisor started");
+    return 0;
+}
+
+void stop_stream_supervisor(void) {
+    pthread_mutex_lock(&supervisor.mutex);
+    if (!supervisor.running) {
+        pthread_mutex_unlock(&supervisor.mutex);
+        return;
+    }
+    supervisor.running = false;
+    pthread_cond_signal(&supervisor.cond);
+    pthread_mutex_unlock(&supervisor.mutex);
+
+    pthread_join(supervisor.thread, NULL);
+    pthread_cond_destroy(&supervisor.cond);
+    log_info("Stream supervisor stopped");
+}
+
+/**
+ * Find the entry of a stage
+ * Must be called with the supervisor mutex held.
+ */
+static supervised_t *find_stage(const char *stream_name, const char *stage) {
+    for (int i = 0; i < SUPERVISOR_MAX_STAGES; i++) {
+        supervised_t *s = &supervisor.stages[i];
+        if (s->used && strcmp(s->stream_name, stream_name) == 0 && strcmp(s->stage, stage) == 0) {
+            return s;
+        }
+    }
+    return NULL;
+}
+
+supervised_t *supervisor_register(const char *stream_name, const char *stage, int timeout_ms,
+                                  supervisor_restart_fn restart) {
+    if (!stream_name || !stage || timeout_ms <= 0) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&supervisor.mutex);
+
+    supervised_t *s = find_stage(stream_name, stage);
+    if (!s) {
+        // A free entry, else the entry of a stage no longer supervised
+        for (int i = 0; i < SUPERVISOR_MAX_STAGES && !s; i++) {
+            if (!supervisor.stages[i].used) {
+                s = &supervisor.stages[i];
+            }
+        }
+        for (int i = 0; i < SUPERVISOR_MAX_STAGES && !s; i++) {
+            if (!supervisor.stages[i].active) {
+                s = &supervisor.stages[i];
+            }
+        }
+        if (!s) {
+            pthread_mutex_unlock(&supervisor.mutex);
+            log_error("No room to supervise stage %s of stream %s", stage, stream_name);
+            return NULL;
+        }
+
+        wheel_remove(s);
+        snprintf(s->stream_name, sizeof(s->stream_name), "%s", stream_name);
+        snprintf(s->stage, sizeof(s->stage), "%s", stage);
+        s->used = true;
+        s->restarts = 0;
+        s->last_restart_ms = 0;
+        s->not_before_ms = 0;
+    }
+
+    int64_t now = now_ms();
+    s->timeout_ms = timeout_ms;
+    s->restart = restart;
+    s->stalled = false;
+    s->active = true;
+    atomic_store(&s->last_beat_ms, now);
+    wheel_insert(s, now + timeout_ms);
+    if (supervisor.running) {
+        pthread_cond_signal(&supervisor.cond);
+    }
+
+    pthread_mutex_unlock(&supervisor.mutex);
+    return s;
+}
+
+void supervisor_unregister(supervised_t *stage) {
+    if (!stage) {
+        return;
+    }
+
+    pthread_mutex_lock(&supervisor.mutex);
+    stage->active = false;
+    stage->stalled = false;
+    wheel_remove(stage);
+    pthread_mutex_unlock(&supervisor.mutex);
+}
+
+void supervisor_beat(supervised_t *stage) {
+    if (stage) {
+        atomic_store_explicit(&stage->last_beat_ms, now_ms(), memory_order_relaxed);
+    }
+}
+
+bool supervisor_report_stall(const char *stream_name, const char *stage) {
+    if (!stream_name || !stage) {
+        return false;
+    }
+
+    pthread_mutex_lock(&supervisor.mutex);
+    supervised_t *s = find_stage(stream_name, stage);
+    bool supervised = s && s->active;
+    if (supervised && !s->stalled) {
+        s->stalled = true;
+        wheel_insert(s, now_ms());
+        if (supervisor.running) {
+            pthread_cond_signal(&supervisor.cond);
+        }
+    }
+    pthread_mutex_unlock(&supervisor.mutex);
+    return supervised;
+}
@@ -1,3 +1,11 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#include <libavutil/hwcontext.h>
+#include <libavutil/opt.h>
+#include <libavutil/pixdesc.h>
+
 #include "video/stream_transcoding.h"
 #include "video/ffmpeg_utils.h"
 #include "video/thread_utils.h"
@@ -5,6 +13,9 @@
 #include "video/timestamp_manager.h"
 #include "video/packet_processor.h"
 #include "video/ffmpeg_leak_detector.h"
+#include "video/hw_decode.h"
+#include "video/packet_pool.h"
+#include "core/config.h"
 #include "core/logger.h"
 
 /**
@@ -23,14 +34,304 @@ void init_transcoding_backend(void) {
 
 /**
  * Cleanup transcoding backend
- * Cleans up FFmpeg and timestamp trackers
+ * Cleans up FFmpeg, timestamp trackers, the hardware decoding device and packet pools
  */
 void cleanup_transcoding_backend(void) {
     // Cleanup timestamp trackers
     cleanup_timestamp_trackers();
 
+    // Release the shared hardware decoding device
+    hw_decode_cleanup();
+
+    // Free the pooled packets and frames
+    packet_pool_cleanup();
+
     // Cleanup FFmpeg
     cleanup_ffmpeg();
 
     log_info("Transcoding backend cleaned up");
 }
+
+/**
+ * H.264 encoders of the hardware backends
+ */
+static const struct {
+    const char *backend;
+    const char *encoder;
+} hw_encoders[] = {
+    { "vaapi",   "h264_vaapi"   },
+    { "cuda",    "h264_nvenc"   },
+    { "qsv",     "h264_qsv"     },
+    { "rkmpp",   "h264_rkmpp"   },
+    { "v4l2m2m", "h264_v4l2m2m" },
+};
+
+// Software encoders currently open
+static atomic_int software_encoders = 0;
+
+/**
+ * Find the H.264 encoder of the selected hardware backend
+ *
+ * @return Encoder, or NULL if the backend has none in this FFmpeg build
+ */
+static const AVCodec *find_hw_encoder(void) {
+    const char *backend = hw_decode_backend_name();
+    for (size_t i = 0; i < sizeof(hw_encoders) / sizeof(hw_encoders[0]); i++) {
+        if (strcmp(hw_encoders[i].backend, backend) == 0) {
+            const AVCodec *codec = avcodec_find_encoder_by_name(hw_encoders[i].encoder);
+            if (!codec) {
+                log_warn("No %s encoder in this FFmpeg build, encoding in software", hw_encoders[i].encoder);
+            }
+            return codec;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Take one of the software encoder slots ([hardware] transcode_max_software)
+ */
+static bool acquire_software_slot(void) {
+    int count = atomic_load(&software_encoders);
+    while (count < g_config.transcode_max_software) {
+        if (atomic_compare_exchange_weak(&software_encoders, &count, count + 1)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Pick the format of the frames an encoder is fed with
+ * NV12 or YUV420P when the encoder takes either, otherwise its first software format.
+ *
+ * @return Software format, or AV_PIX_FMT_NONE if the encoder only takes hardware frames
+ */
+static enum AVPixelFormat pick_sw_format(const AVCodec *codec, enum AVPixelFormat *hw_format) {
+    *hw_format = AV_PIX_FMT_NONE;
+    if (!codec->pix_fmts) {
+        return AV_PIX_FMT_YUV420P;
+    }
+
+    enum AVPixelFormat first_sw = AV_PIX_FMT_NONE;
+    for (const enum AVPixelFormat *p = codec->pix_fmts; *p != AV_PIX_FMT_NONE; p++) {
+        if (*p == AV_PIX_FMT_NV12 || *p == AV_PIX_FMT_YUV420P) {
+            return *p;
+        }
+        const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(*p);
+        if (desc && (desc->flags & AV_PIX_FMT_FLAG_HWACCEL)) {
+            if (*hw_format == AV_PIX_FMT_NONE) {
+                *hw_format = *p;
+            }
+        } else if (first_sw == AV_PIX_FMT_NONE) {
+            first_sw = *p;
+        }
+    }
+    return first_sw;
+}
+
+/**
+ * Set up the surfaces of an encoder that only takes hardware frames (VAAPI)
+ */
+static int setup_hw_frames(transcode_encoder_t *encoder, enum AVPixelFormat hw_format) {
+    AVBufferRef *device_ref = hw_decode_device_ref();
+    if (!device_ref) {
+        log_error("Encoder %s needs a hardware device", encoder->codec_ctx->codec->name);
+        return -1;
+    }
+
+    AVBufferRef *frames_ref = av_hwframe_ctx_alloc(device_ref);
+    av_buffer_unref(&device_ref);
+    if (!frames_ref) {
+        return -1;
+    }
+
+    AVHWFramesContext *frames = (AVHWFramesContext *)frames_ref->data;
+    frames->format = hw_format;
+    frames->sw_format = AV_PIX_FMT_NV12;
+    frames->width = encoder->codec_ctx->width;
+    frames->height = encoder->codec_ctx->height;
+    frames->initial_pool_size = 8;
+
+    int ret = av_hwframe_ctx_init(frames_ref);
+    if (ret < 0) {
+        log_ffmpeg_error(ret, "Failed to create hardware encoder surfaces");
+        av_buffer_unref(&frames_ref);
+        return -1;
+    }
+
+    encoder->codec_ctx->hw_frames_ctx = frames_ref;
+    encoder->codec_ctx->pix_fmt = hw_format;
+    encoder->sw_format = AV_PIX_FMT_NV12;
+    encoder->hw_frame = av_frame_alloc();
+    return encoder->hw_frame ? 0 : -1;
+}
+
+/**
+ * Open an encoder with the given codec
+ */
+static int open_encoder(transcode_encoder_t *encoder, const AVCodec *codec, bool hardware, int width,
+                        int height, AVRational time_base, AVRational frame_rate, int64_t bit_rate,
+                        int gop_size, bool global_header) {
+    memset(encoder, 0, sizeof(*encoder));
+    encoder->hardware = hardware;
+
+    encoder->codec_ctx = avcodec_alloc_context3(codec);
+    if (!encoder->codec_ctx) {
+        return -1;
+    }
+
+    AVCodecContext *ctx = encoder->codec_ctx;
+    ctx->width = width;
+    ctx->height = height;
+    ctx->time_base = time_base;
+    ctx->framerate = frame_rate;
+    ctx->bit_rate = bit_rate;
+    ctx->rc_max_rate = bit_rate * 3 / 2;
+    ctx->rc_buffer_size = (int)bit_rate;
+    ctx->gop_size = gop_size;
+    ctx->max_b_frames = 0;
+    ctx->sample_aspect_ratio = (AVRational){1, 1};
+    if (global_header) {
+        ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    }
+
+    enum AVPixelFormat hw_format;
+    encoder->sw_format = pick_sw_format(codec, &hw_format);
+    if (encoder->sw_format == AV_PIX_FMT_NONE) {
+        if (hw_format == AV_PIX_FMT_NONE || setup_hw_frames(encoder, hw_format) != 0) {
+            transcode_encoder_close(encoder);
+            return -1;
+        }
+    } else {
+        ctx->pix_fmt = encoder->sw_format;
+    }
+
+    AVDictionary *opts = NULL;
+    if (strcmp(codec->name, "libx264") == 0) {
+        av_dict_set(&opts, "preset", "veryfast", 0);
+        av_dict_set(&opts, "tune", "zerolatency", 0);
+    }
+
+    int ret = avcodec_open2(ctx, codec, &opts);
+    av_dict_free(&opts);
+    if (ret < 0) {
+        log_ffmpeg_error(ret, "Failed to open H.264 encoder");
+        transcode_encoder_close(encoder);
+        return -1;
+    }
+
+    log_info("Opened %s encoder for %dx%d at %lld kbps (%s)", codec->name, width, height,
+            (long long)(bit_rate / 1000), hardware ? "hardware" : "software");
+    return 0;
+}
+
+/**
+ * Open an H.264 encoder, in hardware when possible
+ */
+int transcode_encoder_open(transcode_encoder_t *encoder, int width, int height, AVRational time_base,
+                           AVRational frame_rate, int64_t bit_rate, int gop_size, bool global_header) {
+    if (!encoder || width <= 0 || height <= 0) {
+        return -1;
+    }
+    memset(encoder, 0, sizeof(*encoder));
+
+    const AVCodec *codec = find_hw_encoder();
+    if (codec) {
+        if (open_encoder(encoder, codec, true, width, height, time_base, frame_rate, bit_rate,
+                         gop_size, global_header) == 0) {
+            return 0;
+        }
+        log_warn("Hardware encoder %s failed, encoding in software", codec->name);
+    }
+
+    codec = avcodec_find_encoder_by_name("libx264");
+    if (!codec) {
+        codec = avcodec_find_encoder(AV_CODEC_ID_H264);
+    }
+    if (!codec) {
+        log_error("No H.264 encoder available");
+        return -1;
+    }
+
+    // Software encoding takes a CPU core or more, so only a few may run at once
+    if (!acquire_software_slot()) {
+        log_warn("All %d software encoder slots are in use", g_config.transcode_max_software);
+        return TRANSCODE_ENCODER_BUSY;
+    }
+
+    if (open_encoder(encoder, codec, false, width, height, time_base, frame_rate, bit_rate,
+                     gop_size, global_header) != 0) {
+        atomic_fetch_sub(&software_encoders, 1);
+        return -1;
+    }
+    encoder->software_slot = true;
+    return 0;
+}
+
+/**
+ * Send a frame to an encoder
+ */
+int transcode_encoder_send_frame(transcode_encoder_t *encoder, const AVFrame *frame) {
+    if (!encoder || !encoder->codec_ctx) {
+        return AVERROR(EINVAL);
+    }
+
+    if (!frame || !encoder->hw_frame) {
+        return avcodec_send_frame(encoder->codec_ctx, frame);
+    }
+
+    // Upload the pixels to one of the encoder's surfaces
+    av_frame_unref(encoder->hw_frame);
+    int ret = av_hwframe_get_buffer(encoder->codec_ctx->hw_frames_ctx, encoder->hw_frame, 0);
+    if (ret < 0) {
+        return ret;
+    }
+    ret = av_hwframe_transfer_data(encoder->hw_frame, frame, 0);
+    if (ret < 0) {
+        av_frame_unref(encoder->hw_frame);
+        return ret;
+    }
+    av_frame_copy_props(encoder->hw_frame, frame);
+
+    ret = avcodec_send_frame(encoder->codec_ctx, encoder->hw_frame);
+    av_frame_unref(encoder->hw_frame);
+    return ret;
+}
+
+/**
+ * Close an encoder
+ */
+void transcode_encoder_close(transcode_encoder_t *encoder) {
+    if (!encoder) {
+        return;
+    }
+
+    avcodec_free_context(&encoder->codec_ctx);
+    av_frame_free(&encoder->hw_frame);
+    encoder->hardware = false;
+
+    if (encoder->software_slot) {
+        atomic_fetch_sub(&software_encoders, 1);
+        encoder->software_slot = false;
+    }
+}
+
+/**
+ * Get the bit rate to encode a picture height at
+ */
+int64_t transcode_bit_rate(int height) {
+    if (height >= 1080) {
+        return 4000000;
+    }
+    if (height >= 720) {
+        return 2000000;
+    }
+    if (height >= 480) {
+        return 1000000;
+    }
+    if (height >= 360) {
+        return 600000;
+    }
+    return 300000;
+}
@@ -36,13 +36,14 @@ hls_writer_t *get_stream_hls_writer(stream_handle_t stream) {
     }
     
     // Get the stream configuration to get the name
-    stream_config_t config;
-    if (get_stream_config(stream, &config) != 0) {
+    const stream_config_t *config = stream_config_acquire(stream);
+    if (!config) {
         return NULL;
     }
     
     // Get the stream state manager using the name
-    stream_state_manager_t *state = get_stream_state_by_name(config.name);
+    stream_state_manager_t *state = get_stream_state_by_name(config->name);
+    stream_config_release(config);
     if (!state) {
         return NULL;
     }
@@ -63,6 +64,8 @@ hls_writer_t *get_stream_hls_writer(stream_handle_t stream) {
  */
 config_t* get_streaming_config(void) {
     static config_t db_config;
+    // Separate from g_config.streams, which the copy below would otherwise share
+    static stream_config_t *db_streams = NULL;
     static pthread_mutex_t config_mutex = PTHREAD_MUTEX_INITIALIZER;
     
     pthread_mutex_lock(&config_mutex);
@@ -71,15 +74,26 @@ config_t* get_streaming_config(void) {
     // This ensures we get the latest configuration including the database path
     memcpy(&db_config, &g_config, sizeof(config_t));
     
+    // max_streams is fixed after startup, so the buffer is allocated only once
+    if (!db_streams) {
+        db_streams = calloc(g_config.max_streams, sizeof(stream_config_t));
+    }
+    
+    if (!db_streams) {
+        log_error("Failed to allocate memory for stream configurations");
+        pthread_mutex_unlock(&config_mutex);
+        return &g_config;
+    }
+    
+    if (g_config.streams) {
+        memcpy(db_streams, g_config.streams, g_config.max_streams * sizeof(stream_config_t));
+    }
+    db_config.streams = db_streams;
+    
     // Load stream configurations from database
-    stream_config_t db_streams[MAX_STREAMS];
-    int count = get_all_stream_configs(db_streams, MAX_STREAMS);
+    int count = get_all_stream_configs(db_streams, g_config.max_streams);
     
     if (count > 0) {
-        // Copy stream configurations to the config structure
-        for (int i = 0; i < count && i < MAX_STREAMS; i++) {
-            memcpy(&db_config.streams[i], &db_streams[i], sizeof(stream_config_t));
-        }
         db_config.max_streams = count;
     }
     
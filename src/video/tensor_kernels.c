@@ -0,0 +1,313 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "core/logger.h"
+#include "video/tensor_kernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define TENSOR_KERNELS_X86 1
+#include <immintrin.h>
+#elif defined(__aarch64__)
+// Only AArch64 NEON has the float division the normalization needs
+#define TENSOR_KERNELS_NEON 1
+#include <arm_neon.h>
+#endif
+
+/**
+ * Fixed-point BT.601 coefficients with an 8-bit fraction
+ * c = (luma - y_offset) * y_scale
+ * R = (c + rv * Cr + 128) >> 8
+ * G = (c - gu * Cb - gv * Cr + 128) >> 8
+ * B = (c + bu * Cb + 128) >> 8
+ * with Cb and Cr centered on 0.
+ */
+typedef struct {
+    int y_offset;
+    int y_scale;
+    int rv;
+    int gu;
+    int gv;
+    int bu;
+} yuv_coeffs_t;
+
+static const yuv_coeffs_t video_range = { 16, 298, 409, 100, 208, 516 };
+static const yuv_coeffs_t full_range = { 0, 256, 359, 88, 183, 454 };
+
+/**
+ * One destination row: the two luma rows it blends, the chroma rows it
+ * samples and the column tables shared by every row
+ */
+typedef struct {
+    const uint8_t *y0;         // Luma row above
+    const uint8_t *y1;         // Luma row below
+    const uint8_t *u;          // Cb row
+    const uint8_t *v;          // Cr row
+    int wy;                    // Weight of the row below, in 1/256
+    const int32_t *x0;         // Left luma column of each output column
+    const int32_t *x1;         // Right luma column
+    const int32_t *wx;         // Weight of the right column, in 1/256
+    const int32_t *cx;         // Byte offset of the chroma sample in its row
+    int luma_limit;            // A 4-byte read at a luma offset must end by this
+    int chroma_limit;          // Same for the chroma offsets, from u and v alike
+    const yuv_coeffs_t *coeffs;
+    float *r;
+    float *g;
+    float *b;
+    int width;                 // Output columns
+} tensor_row_t;
+
+/**
+ * Vector span of the row conversion
+ * It handles the part of a row it can and returns where it stopped; the
+ * driver finishes the row with the scalar reference. A NULL span falls back
+ * to the scalar reference for the whole image.
+ */
+typedef struct {
+    const char *isa;
+    int (*row_span)(const tensor_row_t *row);
+} tensor_kernels_t;
+
+static tensor_kernels_t kernels = { .isa = "scalar" };
+static pthread_once_t kernels_once = PTHREAD_ONCE_INIT;
+
+/* Scalar reference */
+
+static inline int clamp_byte(int value) {
+    return value < 0 ? 0 : (value > 255 ? 255 : value);
+}
+
+static inline void convert_pixel(const tensor_row_t *row, int x) {
+    int top = row->y0[row->x0[x]] * (256 - row->wx[x]) + row->y0[row->x1[x]] * row->wx[x];
+    int bottom = row->y1[row->x0[x]] * (256 - row->wx[x]) + row->y1[row->x1[x]] * row->wx[x];
+    int luma = (top * (256 - row->wy) + bottom * row->wy + 32768) >> 16;
+    int cb = row->u[row->cx[x]] - 128;
+    int cr = row->v[row->cx[x]] - 128;
+
+    const yuv_coeffs_t *k = row->coeffs;
+    int c = (luma - k->y_offset) * k->y_scale;
+    row->r[x] = clamp_byte((c + k->rv * cr + 128) >> 8) / 255.0f;
+    row->g[x] = clamp_byte((c - k->gu * cb - k->gv * cr + 128) >> 8) / 255.0f;
+    row->b[x] = clamp_byte((c + k->bu * cb + 128) >> 8) / 255.0f;
+}
+
+#if TENSOR_KERNELS_X86
+
+/* AVX2 */
+
+__attribute__((target("avx2")))
+static inline __m256 normalize_avx2(__m256i value) {
+    value = _mm256_min_epi32(_mm256_max_epi32(value, _mm256_setzero_si256()), _mm256_set1_epi32(255));
+    return _mm256_div_ps(_mm256_cvtepi32_ps(value), _mm256_set1_ps(255.0f));
+}
+
+__attribute__((target("avx2")))
+static int row_span_avx2(const tensor_row_t *row) {
+    const yuv_coeffs_t *k = row->coeffs;
+    const __m256i byte_mask = _mm256_set1_epi32(0xFF);
+    const __m256i one = _mm256_set1_epi32(256);
+    const __m256i wy = _mm256_set1_epi32(row->wy);
+    const __m256i wy_inv = _mm256_set1_epi32(256 - row->wy);
+    const __m256i luma_round = _mm256_set1_epi32(32768);
+    const __m256i chroma_bias = _mm256_set1_epi32(128);
+    const __m256i y_offset = _mm256_set1_epi32(k->y_offset);
+    const __m256i y_scale = _mm256_set1_epi32(k->y_scale);
+    const __m256i rv = _mm256_set1_epi32(k->rv);
+    const __m256i gu = _mm256_set1_epi32(k->gu);
+    const __m256i gv = _mm256_set1_epi32(k->gv);
+    const __m256i bu = _mm256_set1_epi32(k->bu);
+
+    int x = 0;
+    for (; x + 8 <= row->width; x += 8) {
+        // Each gather reads 4 bytes: the left column and, next to it, the right one.
+        // Columns only grow, so once the last lane reads too far the scalar code takes over
+        if (row->x0[x + 7] + 4 > row->luma_limit || row->cx[x + 7] + 4 > row->chroma_limit) {
+            break;
+        }
+
+        __m256i x0 = _mm256_loadu_si256((const __m256i *)(row->x0 + x));
+        __m256i wx = _mm256_loadu_si256((const __m256i *)(row->wx + x));
+        __m256i wx_inv = _mm256_sub_epi32(one, wx);
+
+        __m256i t = _mm256_i32gather_epi32((const int *)row->y0, x0, 1);
+        __m256i b = _mm256_i32gather_epi32((const int *)row->y1, x0, 1);
+        __m256i top = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_and_si256(t, byte_mask), wx_inv),
+                                       _mm256_mullo_epi32(_mm256_and_si256(_mm256_srli_epi32(t, 8), byte_mask), wx));
+        __m256i bottom = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_and_si256(b, byte_mask), wx_inv),
+                                          _mm256_mullo_epi32(_mm256_and_si256(_mm256_srli_epi32(b, 8), byte_mask), wx));
+        __m256i luma = _mm256_add_epi32(_mm256_mullo_epi32(top, wy_inv), _mm256_mullo_epi32(bottom, wy));
+        luma = _mm256_srli_epi32(_mm256_add_epi32(luma, luma_round), 16);
+
+        __m256i cx = _mm256_loadu_si256((const __m256i *)(row->cx + x));
+        __m256i cb = _mm256_sub_epi32(_mm256_and_si256(_mm256_i32gather_epi32((const int *)row->u, cx, 1), byte_mask),
+                                      chroma_bias);
+        __m256i cr = _mm256_sub_epi32(_mm256_and_si256(_mm256_i32gather_epi32((const int *)row->v, cx, 1), byte_mask),
+                                      chroma_bias);
+
+        __m256i c = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_sub_epi32(luma, y_offset), y_scale), chroma_bias);
+        __m256i r = _mm256_srai_epi32(_mm256_add_epi32(c, _mm256_mullo_epi32(cr, rv)), 8);
+        __m256i g = _mm256_srai_epi32(_mm256_sub_epi32(_mm256_sub_epi32(c, _mm256_mullo_epi32(cb, gu)),
+                                                       _mm256_mullo_epi32(cr, gv)), 8);
+        __m256i bl = _mm256_srai_epi32(_mm256_add_epi32(c, _mm256_mullo_epi32(cb, bu)), 8);
+
+        _mm256_storeu_ps(row->r + x, normalize_avx2(r));
+        _mm256_storeu_ps(row->g + x, normalize_avx2(g));
+        _mm256_storeu_ps(row->b + x, normalize_avx2(bl));
+    }
+    return x;
+}
+
+#endif /* TENSOR_KERNELS_X86 */
+
+#if TENSOR_KERNELS_NEON
+
+/* NEON */
+
+static inline float32x4_t normalize_neon(int32x4_t value) {
+    value = vminq_s32(vmaxq_s32(value, vdupq_n_s32(0)), vdupq_n_s32(255));
+    return vdivq_f32(vcvtq_f32_s32(value), vdupq_n_f32(255.0f));
+}
+
+static int row_span_neon(const tensor_row_t *row) {
+    const yuv_coeffs_t *k = row->coeffs;
+    const int32x4_t wy = vdupq_n_s32(row->wy);
+    const int32x4_t wy_inv = vdupq_n_s32(256 - row->wy);
+    const int32x4_t chroma_bias = vdupq_n_s32(128);
+
+    int x = 0;
+    for (; x + 4 <= row->width; x += 4) {
+        // NEON has no gather; the samples are loaded lane by lane and the math is vectorized
+        int32_t tl[4], tr[4], bl[4], br[4], u[4], v[4];
+        for (int i = 0; i < 4; i++) {
+            tl[i] = row->y0[row->x0[x + i]];
+            tr[i] = row->y0[row->x1[x + i]];
+            bl[i] = row->y1[row->x0[x + i]];
+            br[i] = row->y1[row->x1[x + i]];
+            u[i] = row->u[row->cx[x + i]];
+            v[i] = row->v[row->cx[x + i]];
+        }
+
+        int32x4_t wx = vld1q_s32(row->wx + x);
+        int32x4_t wx_inv = vsubq_s32(vdupq_n_s32(256), wx);
+        int32x4_t top = vaddq_s32(vmulq_s32(vld1q_s32(tl), wx_inv), vmulq_s32(vld1q_s32(tr), wx));
+        int32x4_t bottom = vaddq_s32(vmulq_s32(vld1q_s32(bl), wx_inv), vmulq_s32(vld1q_s32(br), wx));
+        int32x4_t luma = vaddq_s32(vmulq_s32(top, wy_inv), vmulq_s32(bottom, wy));
+        luma = vreinterpretq_s32_u32(vshrq_n_u32(vreinterpretq_u32_s32(vaddq_s32(luma, vdupq_n_s32(32768))), 16));
+
+        int32x4_t cb = vsubq_s32(vld1q_s32(u), chroma_bias);
+        int32x4_t cr = vsubq_s32(vld1q_s32(v), chroma_bias);
+
+        int32x4_t c = vaddq_s32(vmulq_n_s32(vsubq_s32(luma, vdupq_n_s32(k->y_offset)), k->y_scale), chroma_bias);
+        int32x4_t r = vshrq_n_s32(vaddq_s32(c, vmulq_n_s32(cr, k->rv)), 8);
+        int32x4_t g = vshrq_n_s32(vsubq_s32(vsubq_s32(c, vmulq_n_s32(cb, k->gu)), vmulq_n_s32(cr, k->gv)), 8);
+        int32x4_t b = vshrq_n_s32(vaddq_s32(c, vmulq_n_s32(cb, k->bu)), 8);
+
+        vst1q_f32(row->r + x, normalize_neon(r));
+        vst1q_f32(row->g + x, normalize_neon(g));
+        vst1q_f32(row->b + x, normalize_neon(b));
+    }
+    return x;
+}
+
+#endif /* TENSOR_KERNELS_NEON */
+
+/**
+ * Pick the widest implementation the CPU supports
+ */
+static void select_kernels(void) {
+#if TENSOR_KERNELS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        kernels = (tensor_kernels_t){
+            .isa = "avx2",
+            .row_span = row_span_avx2,
+        };
+    }
+#elif TENSOR_KERNELS_NEON
+    kernels = (tensor_kernels_t){
+        .isa = "neon",
+        .row_span = row_span_neon,
+    };
+#endif
+
+    log_info("Model input kernels: %s", kernels.isa);
+}
+
+static inline const tensor_kernels_t *get_kernels(void) {
+    pthread_once(&kernels_once, select_kernels);
+    return &kernels;
+}
+
+/**
+ * Source position of an output coordinate with the corners aligned, in 1/256
+ */
+static inline int source_position(int i, int src_size, int dst_size) {
+    return dst_size > 1 ? (int)((int64_t)i * (src_size - 1) * 256 / (dst_size - 1)) : 0;
+}
+
+const char *tensor_kernels_isa(void) {
+    return get_kernels()->isa;
+}
+
+int tensor_from_yuv420(const yuv420_image_t *src, float *dst, int dst_width, int dst_height) {
+    if (!src || !src->y || !src->u || !src->v || !dst || src->width < 2 || src->height < 2 ||
+        src->uv_step < 1 || dst_width < 1 || dst_height < 1 || dst_width > TENSOR_MAX_WIDTH) {
+        return -1;
+    }
+
+    const tensor_kernels_t *k = get_kernels();
+    int32_t x0[TENSOR_MAX_WIDTH];
+    int32_t x1[TENSOR_MAX_WIDTH];
+    int32_t wx[TENSOR_MAX_WIDTH];
+    int32_t cx[TENSOR_MAX_WIDTH];
+    int chroma_width = (src->width + 1) / 2;
+    int chroma_height = (src->height + 1) / 2;
+
+    for (int x = 0; x < dst_width; x++) {
+        int pos = source_position(x, src->width, dst_width);
+        x0[x] = pos >> 8;
+        x1[x] = x0[x] + 1 < src->width ? x0[x] + 1 : x0[x];
+        wx[x] = pos & 0xFF;
+        int chroma = ((pos + 128) >> 8) / 2;
+        cx[x] = (chroma < chroma_width ? chroma : chroma_width - 1) * src->uv_step;
+    }
+
+    size_t plane = (size_t)dst_width * dst_height;
+    tensor_row_t row = {
+        .x0 = x0,
+        .x1 = x1,
+        .wx = wx,
+        .cx = cx,
+        .luma_limit = src->width,
+        // With interleaved chroma, v starts one byte after u
+        .chroma_limit = chroma_width * src->uv_step - (src->uv_step - 1),
+        .coeffs = src->full_range ? &full_range : &video_range,
+        .width = dst_width,
+    };
+
+    for (int y = 0; y < dst_height; y++) {
+        int pos = source_position(y, src->height, dst_height);
+        int y0 = pos >> 8;
+        int y1 = y0 + 1 < src->height ? y0 + 1 : y0;
+        int chroma = ((pos + 128) >> 8) / 2;
+        if (chroma >= chroma_height) {
+            chroma = chroma_height - 1;
+        }
+
+        row.y0 = src->y + (size_t)y0 * src->y_stride;
+        row.y1 = src->y + (size_t)y1 * src->y_stride;
+        row.u = src->u + (size_t)chroma * src->uv_stride;
+        row.v = src->v + (size_t)chroma * src->uv_stride;
+        row.wy = pos & 0xFF;
+        row.r = dst + (size_t)y * dst_width;
+        row.g = row.r + plane;
+        row.b = row.g + plane;
+
+        int x = k->row_span ? k->row_span(&row) : 0;
+        for (; x < dst_width; x++) {
+            convert_pixel(&row, x);
+        }
+    }
+    return 0;
+}
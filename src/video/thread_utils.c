@@ -1,8 +1,16 @@
+#define _GNU_SOURCE
 #include "video/thread_utils.h"
 #include "core/logger.h"
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <errno.h>
 #include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
 
 // Define CLOCK_REALTIME if not available
 #ifndef CLOCK_REALTIME
@@ -170,3 +178,294 @@ int pthread_join_with_timeout(pthread_t thread, void **retval, int timeout_sec)
     
     return ret;
 }
+
+/**
+ * Create a thread with an explicit stack size
+ */
+int pthread_create_with_stack(pthread_t *thread, void *(*start_routine)(void *), void *arg,
+                              size_t stack_size, bool detached) {
+    pthread_attr_t attr;
+    int ret = pthread_attr_init(&attr);
+    if (ret != 0) {
+        return ret;
+    }
+
+    pthread_attr_setdetachstate(&attr, detached ? PTHREAD_CREATE_DETACHED : PTHREAD_CREATE_JOINABLE);
+
+    if (stack_size > 0 && pthread_attr_setstacksize(&attr, stack_size) != 0) {
+        log_warn("Failed to set thread stack size to %zu bytes, using default", stack_size);
+    }
+
+    ret = pthread_create(thread, &attr, start_routine, arg);
+    pthread_attr_destroy(&attr);
+    return ret;
+}
+
+// Threads remembered between calls of thread_get_cpu_usage()
+#define CPU_SAMPLE_MAX 512
+
+static pthread_mutex_t sched_mutex = PTHREAD_MUTEX_INITIALIZER;
+static thread_sched_config_t class_sched[THREAD_CLASS_COUNT];
+static bool class_warned[THREAD_CLASS_COUNT];
+
+static pthread_mutex_t sample_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int sample_tids[CPU_SAMPLE_MAX];
+static unsigned long long sample_ticks[CPU_SAMPLE_MAX];
+static int sample_count = 0;
+static struct timespec sample_time;
+
+void thread_utils_configure(const thread_sched_config_t *sched) {
+    if (!sched) {
+        return;
+    }
+
+    pthread_mutex_lock(&sched_mutex);
+    memcpy(class_sched, sched, sizeof(class_sched));
+    memset(class_warned, 0, sizeof(class_warned));
+    pthread_mutex_unlock(&sched_mutex);
+}
+
+/**
+ * Parse a CPU list such as "0-3,6"
+ */
+static int parse_cpu_list(const char *list, cpu_set_t *set) {
+    CPU_ZERO(set);
+
+    const char *p = list;
+    while (*p) {
+        char *end;
+        long first = strtol(p, &end, 10);
+        if (end == p || first < 0 || first >= CPU_SETSIZE) {
+            return -1;
+        }
+        long last = first;
+        p = end;
+        if (*p == '-') {
+            last = strtol(p + 1, &end, 10);
+            if (end == p + 1 || last < first || last >= CPU_SETSIZE) {
+                return -1;
+            }
+            p = end;
+        }
+        for (long cpu = first; cpu <= last; cpu++) {
+            CPU_SET((int)cpu, set);
+        }
+        while (*p == ',' || *p == ' ') {
+            p++;
+        }
+    }
+
+    return CPU_COUNT(set) > 0 ? 0 : -1;
+}
+
+/**
+ * Apply the scheduling of a class to the calling thread
+ * Failures are logged once per class, they usually mean missing privileges.
+ */
+static void apply_sched(thread_class_t thread_class) {
+    pthread_mutex_lock(&sched_mutex);
+    thread_sched_config_t sched = class_sched[thread_class];
+    pthread_mutex_unlock(&sched_mutex);
+
+    pid_t tid = (pid_t)syscall(SYS_gettid);
+    const char *failed = NULL;
+    int error = 0;
+
+    if (sched.cpus[0] != '\0') {
+        cpu_set_t set;
+        if (parse_cpu_list(sched.cpus, &set) != 0) {
+            failed = "CPU list";
+            error = EINVAL;
+        } else if (sched_setaffinity(tid, sizeof(set), &set) != 0) {
+            failed = "CPU affinity";
+            error = errno;
+        }
+    }
+
+    if (sched.policy != THREAD_POLICY_NORMAL) {
+        struct sched_param param = {0};
+        int policy = sched.policy == THREAD_POLICY_IDLE ? SCHED_IDLE : SCHED_BATCH;
+        if (sched_setscheduler(tid, policy, &param) != 0) {
+            failed = "scheduling policy";
+            error = errno;
+        }
+    }
+
+    // On Linux the nice value of a thread is set through its thread ID
+    if (sched.nice != 0 && setpriority(PRIO_PROCESS, (id_t)tid, sched.nice) != 0) {
+        failed = "nice value";
+        error = errno;
+    }
+
+    if (failed) {
+        pthread_mutex_lock(&sched_mutex);
+        bool warned = class_warned[thread_class];
+        class_warned[thread_class] = true;
+        pthread_mutex_unlock(&sched_mutex);
+
+        if (!warned) {
+            log_warn("Could not apply %s to %s threads: %s", failed, thread_class_name(thread_class),
+                     strerror(error));
+        }
+    }
+}
+
+void thread_set_identity(thread_class_t thread_class, const char *role, const char *detail) {
+    char name[THREAD_NAME_MAX + 1];
+    if (detail && detail[0] != '\0') {
+        snprintf(name, sizeof(name), "%s:%s", role, detail);
+    } else {
+        snprintf(name, sizeof(name), "%s", role);
+    }
+    pthread_setname_np(pthread_self(), name);
+
+    if (thread_class >= 0 && thread_class < THREAD_CLASS_COUNT) {
+        apply_sched(thread_class);
+    }
+}
+
+/**
+ * Read the name and CPU times of one thread from /proc/self/task/<tid>/stat
+ */
+static int read_thread_stat(int tid, thread_cpu_usage_t *usage, unsigned long long *ticks) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/self/task/%d/stat", tid);
+
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        return -1;
+    }
+    char line[1024];
+    bool ok = fgets(line, sizeof(line), file) != NULL;
+    fclose(file);
+    if (!ok) {
+        return -1;
+    }
+
+    // The name may contain spaces and parentheses, so it ends at the last ')'
+    char *open = strchr(line, '(');
+    char *close = strrchr(line, ')');
+    if (!open || !close || close < open) {
+        return -1;
+    }
+    size_t len = (size_t)(close - open - 1);
+    if (len > THREAD_NAME_MAX) {
+        len = THREAD_NAME_MAX;
+    }
+    memcpy(usage->name, open + 1, len);
+    usage->name[len] = '\0';
+
+    // Fields after the name, starting with field 3 (state)
+    unsigned long long utime = 0, stime = 0;
+    long nice = 0;
+    int processor = -1;
+    int field = 3;
+    char *save = NULL;
+    for (char *token = strtok_r(close + 1, " ", &save); token; token = strtok_r(NULL, " ", &save), field++) {
+        if (field == 14) {
+            utime = strtoull(token, NULL, 10);
+        } else if (field == 15) {
+            stime = strtoull(token, NULL, 10);
+        } else if (field == 19) {
+            nice = strtol(token, NULL, 10);
+        } else if (field == 39) {
+            processor = atoi(token);
+            break;
+        }
+    }
+
+    long hz = sysconf(_SC_CLK_TCK);
+    if (hz <= 0) {
+        hz = 100;
+    }
+
+    usage->tid = tid;
+    usage->user_seconds = (double)utime / (double)hz;
+    usage->system_seconds = (double)stime / (double)hz;
+    usage->nice = (int)nice;
+    usage->last_cpu = processor;
+    *ticks = utime + stime;
+    return 0;
+}
+
+static int compare_cpu_usage(const void *a, const void *b) {
+    const thread_cpu_usage_t *ua = a;
+    const thread_cpu_usage_t *ub = b;
+    if (ua->cpu_percent != ub->cpu_percent) {
+        return ua->cpu_percent < ub->cpu_percent ? 1 : -1;
+    }
+    double ta = ua->user_seconds + ua->system_seconds;
+    double tb = ub->user_seconds + ub->system_seconds;
+    return ta < tb ? 1 : (ta > tb ? -1 : 0);
+}
+
+int thread_get_cpu_usage(thread_cpu_usage_t *threads, int max_count) {
+    if (!threads || max_count <= 0) {
+        return -1;
+    }
+
+    DIR *dir = opendir("/proc/self/task");
+    if (!dir) {
+        log_error("Failed to open /proc/self/task: %s", strerror(errno));
+        return -1;
+    }
+
+    int count = 0;
+    int new_tids[CPU_SAMPLE_MAX];
+    unsigned long long new_ticks[CPU_SAMPLE_MAX];
+    int new_count = 0;
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    pthread_mutex_lock(&sample_mutex);
+
+    double elapsed = (double)(now.tv_sec - sample_time.tv_sec) +
+                     (double)(now.tv_nsec - sample_time.tv_nsec) / 1e9;
+    long hz = sysconf(_SC_CLK_TCK);
+    if (hz <= 0) {
+        hz = 100;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL && count < max_count) {
+        if (entry->d_name[0] < '0' || entry->d_name[0] > '9') {
+            continue;
+        }
+
+        int tid = atoi(entry->d_name);
+        unsigned long long ticks;
+        thread_cpu_usage_t *usage = &threads[count];
+        if (read_thread_stat(tid, usage, &ticks) != 0) {
+            continue;   // Exited while we were looking
+        }
+
+        usage->cpu_percent = -1.0;
+        for (int i = 0; i < sample_count; i++) {
+            if (sample_tids[i] == tid) {
+                if (elapsed > 0 && ticks >= sample_ticks[i]) {
+                    usage->cpu_percent = (double)(ticks - sample_ticks[i]) / (double)hz / elapsed * 100.0;
+                }
+                break;
+            }
+        }
+
+        if (new_count < CPU_SAMPLE_MAX) {
+            new_tids[new_count] = tid;
+            new_ticks[new_count] = ticks;
+            new_count++;
+        }
+        count++;
+    }
+    closedir(dir);
+
+    memcpy(sample_tids, new_tids, sizeof(int) * (size_t)new_count);
+    memcpy(sample_ticks, new_ticks, sizeof(unsigned long long) * (size_t)new_count);
+    sample_count = new_count;
+    sample_time = now;
+
+    pthread_mutex_unlock(&sample_mutex);
+
+    qsort(threads, (size_t)count, sizeof(thread_cpu_usage_t), compare_cpu_usage);
+    return count;
+}
@@ -12,7 +12,7 @@
 #include <libavutil/avutil.h>
 
 // Structure to track timestamp information per stream
-typedef struct {
+struct timestamp_tracker {
     char stream_name[MAX_STREAM_NAME];
     int64_t last_pts;
     int64_t last_dts;
@@ -22,92 +22,108 @@ typedef struct {
     bool initialized;
     time_t last_keyframe_time;  // Time when the last keyframe was received
     time_t last_detection_time; // Time when the last detection was performed
-} timestamp_tracker_t;
+};
 
 // Array to track timestamps for multiple streams
+// Trackers never move, so callers can keep a pointer to their stream's tracker
 #define MAX_TIMESTAMP_TRACKERS 16
 static timestamp_tracker_t timestamp_trackers[MAX_TIMESTAMP_TRACKERS];
 
+// Protects name lookups and slot allocation; the per-tracker fields are plain
+// stores from the stream's own threads, as before
+static pthread_mutex_t trackers_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Reset the timing state of a tracker
+ */
+static void clear_tracker_state(timestamp_tracker_t *tracker) {
+    tracker->last_pts = AV_NOPTS_VALUE;
+    tracker->last_dts = AV_NOPTS_VALUE;
+    tracker->pts_discontinuity_count = 0;
+    tracker->expected_next_pts = AV_NOPTS_VALUE;
+    tracker->last_keyframe_time = 0;
+    tracker->last_detection_time = 0;
+}
+
+/**
+ * Assign a tracker slot to a stream
+ */
+static void assign_tracker(timestamp_tracker_t *tracker, const char *stream_name) {
+    strncpy(tracker->stream_name, stream_name, MAX_STREAM_NAME - 1);
+    tracker->stream_name[MAX_STREAM_NAME - 1] = '\0';
+    clear_tracker_state(tracker);
+
+    // We'll set this based on the actual protocol when processing packets
+    tracker->is_udp_stream = false;
+    tracker->initialized = true;
+}
+
+/**
+ * Find the tracker of a stream
+ * Must be called with trackers_mutex held.
+ */
+static timestamp_tracker_t *find_tracker(const char *stream_name) {
+    for (int i = 0; i < MAX_TIMESTAMP_TRACKERS; i++) {
+        if (timestamp_trackers[i].initialized &&
+            strcmp(timestamp_trackers[i].stream_name, stream_name) == 0) {
+            return &timestamp_trackers[i];
+        }
+    }
+    return NULL;
+}
+
 /**
  * Get or create a timestamp tracker for a stream
  */
-void *get_timestamp_tracker(const char *stream_name) {
+timestamp_tracker_t *get_timestamp_tracker(const char *stream_name) {
     if (!stream_name) {
         log_error("get_timestamp_tracker: NULL stream name");
         return NULL;
     }
-    
-    // Make a local copy of the stream name to avoid issues with concurrent access
-    char local_stream_name[MAX_STREAM_NAME];
-    strncpy(local_stream_name, stream_name, MAX_STREAM_NAME - 1);
-    local_stream_name[MAX_STREAM_NAME - 1] = '\0';
-    
+
+    pthread_mutex_lock(&trackers_mutex);
 
     // Look for existing tracker
-    for (int i = 0; i < MAX_TIMESTAMP_TRACKERS; i++) {
-        if (timestamp_trackers[i].initialized && 
-            strcmp(timestamp_trackers[i].stream_name, local_stream_name) == 0) {
-            return &timestamp_trackers[i];
-        }
+    timestamp_tracker_t *tracker = find_tracker(stream_name);
+    if (tracker) {
+        pthread_mutex_unlock(&trackers_mutex);
+        return tracker;
     }
-    
+
     // Create new tracker
     for (int i = 0; i < MAX_TIMESTAMP_TRACKERS; i++) {
         if (!timestamp_trackers[i].initialized) {
-            strncpy(timestamp_trackers[i].stream_name, local_stream_name, MAX_STREAM_NAME - 1);
-            timestamp_trackers[i].stream_name[MAX_STREAM_NAME - 1] = '\0';
-            timestamp_trackers[i].last_pts = AV_NOPTS_VALUE;
-            timestamp_trackers[i].last_dts = AV_NOPTS_VALUE;
-            timestamp_trackers[i].pts_discontinuity_count = 0;
-            timestamp_trackers[i].expected_next_pts = AV_NOPTS_VALUE;
-            
-            // We'll set this based on the actual protocol when processing packets
-            timestamp_trackers[i].is_udp_stream = false;
-            
-            // Initialize last keyframe time to 0
-            timestamp_trackers[i].last_keyframe_time = 0;
-            
-            // Initialize last detection time to 0
-            timestamp_trackers[i].last_detection_time = 0;
-            
-            timestamp_trackers[i].initialized = true;
-            
-            log_info("Created new timestamp tracker for stream %s at index %d", 
-                    local_stream_name, i);
-            
+            assign_tracker(&timestamp_trackers[i], stream_name);
+            pthread_mutex_unlock(&trackers_mutex);
+
+            log_info("Created new timestamp tracker for stream %s at index %d", stream_name, i);
             return &timestamp_trackers[i];
         }
     }
-    
+
     // If we get here, all slots are in use. Try to find a stale tracker to reuse.
     // A tracker is considered stale if it hasn't received a keyframe in the last 5 minutes
     time_t current_time = time(NULL);
     for (int i = 0; i < MAX_TIMESTAMP_TRACKERS; i++) {
-        if (timestamp_trackers[i].initialized && 
+        if (timestamp_trackers[i].initialized &&
             timestamp_trackers[i].last_keyframe_time > 0 &&
             (current_time - timestamp_trackers[i].last_keyframe_time) > 300) { // 5 minutes
-            
+
             log_warn("Reusing stale timestamp tracker for stream %s (previously used by %s, last keyframe %ld seconds ago)",
-                    local_stream_name, timestamp_trackers[i].stream_name, 
+                    stream_name, timestamp_trackers[i].stream_name,
                     (long)(current_time - timestamp_trackers[i].last_keyframe_time));
-            
+
             // Reset the tracker for the new stream
-            strncpy(timestamp_trackers[i].stream_name, local_stream_name, MAX_STREAM_NAME - 1);
-            timestamp_trackers[i].stream_name[MAX_STREAM_NAME - 1] = '\0';
-            timestamp_trackers[i].last_pts = AV_NOPTS_VALUE;
-            timestamp_trackers[i].last_dts = AV_NOPTS_VALUE;
-            timestamp_trackers[i].pts_discontinuity_count = 0;
-            timestamp_trackers[i].expected_next_pts = AV_NOPTS_VALUE;
-            timestamp_trackers[i].is_udp_stream = false;
-            timestamp_trackers[i].last_keyframe_time = 0;
-            timestamp_trackers[i].last_detection_time = 0;
-            
+            assign_tracker(&timestamp_trackers[i], stream_name);
+            pthread_mutex_unlock(&trackers_mutex);
             return &timestamp_trackers[i];
         }
     }
-    
+
+    pthread_mutex_unlock(&trackers_mutex);
+
     // No slots available
-    log_error("No available slots for timestamp tracker for stream %s", local_stream_name);
+    log_error("No available slots for timestamp tracker for stream %s", stream_name);
     return NULL;
 }
 
@@ -115,23 +131,34 @@ void *get_timestamp_tracker(const char *stream_name) {
  * Initialize timestamp trackers
  */
 void init_timestamp_trackers(void) {
+    pthread_mutex_lock(&trackers_mutex);
 
     // Initialize all trackers to unused state
     for (int i = 0; i < MAX_TIMESTAMP_TRACKERS; i++) {
+        clear_tracker_state(&timestamp_trackers[i]);
         timestamp_trackers[i].initialized = false;
-        timestamp_trackers[i].last_pts = AV_NOPTS_VALUE;
-        timestamp_trackers[i].last_dts = AV_NOPTS_VALUE;
-        timestamp_trackers[i].pts_discontinuity_count = 0;
-        timestamp_trackers[i].expected_next_pts = AV_NOPTS_VALUE;
         timestamp_trackers[i].is_udp_stream = false;
-        timestamp_trackers[i].last_keyframe_time = 0;
-        timestamp_trackers[i].last_detection_time = 0;
         timestamp_trackers[i].stream_name[0] = '\0';
     }
-    
+
+    pthread_mutex_unlock(&trackers_mutex);
+
     log_info("Timestamp trackers initialized");
 }
 
+/**
+ * Set the UDP flag of a tracker
+ */
+void timestamp_tracker_set_udp_flag(timestamp_tracker_t *tracker, bool is_udp) {
+    if (!tracker) {
+        return;
+    }
+
+    tracker->is_udp_stream = is_udp;
+    log_info("Set UDP flag to %s for stream %s timestamp tracker",
+            is_udp ? "true" : "false", tracker->stream_name);
+}
+
 /**
  * Set the UDP flag for a stream's timestamp tracker
  * Creates the tracker if it doesn't exist
@@ -141,53 +168,8 @@ void set_timestamp_tracker_udp_flag(const char *stream_name, bool is_udp) {
         log_error("set_timestamp_tracker_udp_flag: NULL stream name");
         return;
     }
-    
-    // Make a local copy of the stream name to avoid issues with concurrent access
-    char local_stream_name[MAX_STREAM_NAME];
-    strncpy(local_stream_name, stream_name, MAX_STREAM_NAME - 1);
-    local_stream_name[MAX_STREAM_NAME - 1] = '\0';
 
-    // Look for existing tracker
-    int found = 0;
-    for (int i = 0; i < MAX_TIMESTAMP_TRACKERS; i++) {
-        if (timestamp_trackers[i].initialized && 
-            strcmp(timestamp_trackers[i].stream_name, local_stream_name) == 0) {
-            // Set the UDP flag
-            timestamp_trackers[i].is_udp_stream = is_udp;
-            log_info("Set UDP flag to %s for stream %s timestamp tracker", 
-                    is_udp ? "true" : "false", local_stream_name);
-            found = 1;
-            break;
-        }
-    }
-    
-    // If not found, create a new tracker
-    if (!found) {
-        for (int i = 0; i < MAX_TIMESTAMP_TRACKERS; i++) {
-            if (!timestamp_trackers[i].initialized) {
-                // Initialize the new tracker
-                strncpy(timestamp_trackers[i].stream_name, local_stream_name, MAX_STREAM_NAME - 1);
-                timestamp_trackers[i].stream_name[MAX_STREAM_NAME - 1] = '\0';
-                timestamp_trackers[i].last_pts = AV_NOPTS_VALUE;
-                timestamp_trackers[i].last_dts = AV_NOPTS_VALUE;
-                timestamp_trackers[i].pts_discontinuity_count = 0;
-                timestamp_trackers[i].expected_next_pts = AV_NOPTS_VALUE;
-                timestamp_trackers[i].is_udp_stream = is_udp;
-                timestamp_trackers[i].last_keyframe_time = 0;
-                timestamp_trackers[i].last_detection_time = 0;
-                timestamp_trackers[i].initialized = true;
-                
-                log_info("Created new timestamp tracker for stream %s at index %d with UDP flag %s", 
-                        local_stream_name, i, is_udp ? "true" : "false");
-                found = 1;
-                break;
-            }
-        }
-        
-        if (!found) {
-            log_error("No available slots for timestamp tracker for stream %s", local_stream_name);
-        }
-    }
+    timestamp_tracker_set_udp_flag(get_timestamp_tracker(stream_name), is_udp);
 }
 
 /**
@@ -200,28 +182,21 @@ void reset_timestamp_tracker(const char *stream_name) {
         return;
     }
 
-    // Find the tracker for this stream
-    bool found = false;
-    for (int i = 0; i < MAX_TIMESTAMP_TRACKERS; i++) {
-        if (timestamp_trackers[i].initialized && 
-            strcmp(timestamp_trackers[i].stream_name, stream_name) == 0) {
-            // Reset the tracker but keep the stream name and initialized flag
-            // This ensures we don't lose the UDP flag setting
-            timestamp_trackers[i].last_pts = AV_NOPTS_VALUE;
-            timestamp_trackers[i].last_dts = AV_NOPTS_VALUE;
-            timestamp_trackers[i].pts_discontinuity_count = 0;
-            timestamp_trackers[i].expected_next_pts = AV_NOPTS_VALUE;
-            timestamp_trackers[i].last_keyframe_time = 0;
-            timestamp_trackers[i].last_detection_time = 0;
-            
-            log_info("Reset timestamp tracker for stream %s (UDP flag: %s)", 
-                    stream_name, timestamp_trackers[i].is_udp_stream ? "true" : "false");
-            found = true;
-            break;
-        }
+    pthread_mutex_lock(&trackers_mutex);
+
+    // Reset the tracker but keep the stream name and initialized flag
+    // This ensures we don't lose the UDP flag setting
+    timestamp_tracker_t *tracker = find_tracker(stream_name);
+    if (tracker) {
+        clear_tracker_state(tracker);
     }
-    
-    if (!found) {
+
+    pthread_mutex_unlock(&trackers_mutex);
+
+    if (tracker) {
+        log_info("Reset timestamp tracker for stream %s (UDP flag: %s)",
+                stream_name, tracker->is_udp_stream ? "true" : "false");
+    } else {
         log_debug("No timestamp tracker found for stream %s during reset", stream_name);
     }
 }
@@ -236,29 +211,22 @@ void remove_timestamp_tracker(const char *stream_name) {
         return;
     }
 
-    // Find the tracker for this stream
-    bool found = false;
-    for (int i = 0; i < MAX_TIMESTAMP_TRACKERS; i++) {
-        if (timestamp_trackers[i].initialized && 
-            strcmp(timestamp_trackers[i].stream_name, stream_name) == 0) {
-            // Completely reset the tracker
-            timestamp_trackers[i].initialized = false;
-            timestamp_trackers[i].stream_name[0] = '\0';
-            timestamp_trackers[i].last_pts = AV_NOPTS_VALUE;
-            timestamp_trackers[i].last_dts = AV_NOPTS_VALUE;
-            timestamp_trackers[i].pts_discontinuity_count = 0;
-            timestamp_trackers[i].expected_next_pts = AV_NOPTS_VALUE;
-            timestamp_trackers[i].is_udp_stream = false;
-            timestamp_trackers[i].last_keyframe_time = 0;
-            timestamp_trackers[i].last_detection_time = 0;
-            
-            log_info("Removed timestamp tracker for stream %s", stream_name);
-            found = true;
-            break;
-        }
+    pthread_mutex_lock(&trackers_mutex);
+
+    // Completely reset the tracker
+    timestamp_tracker_t *tracker = find_tracker(stream_name);
+    if (tracker) {
+        clear_tracker_state(tracker);
+        tracker->initialized = false;
+        tracker->is_udp_stream = false;
+        tracker->stream_name[0] = '\0';
     }
-    
-    if (!found) {
+
+    pthread_mutex_unlock(&trackers_mutex);
+
+    if (tracker) {
+        log_info("Removed timestamp tracker for stream %s", stream_name);
+    } else {
         log_debug("No timestamp tracker found for stream %s during removal", stream_name);
     }
 }
@@ -268,22 +236,41 @@ void remove_timestamp_tracker(const char *stream_name) {
  */
 void cleanup_timestamp_trackers(void) {
     log_info("Cleaning up timestamp trackers...");
+
+    pthread_mutex_lock(&trackers_mutex);
+
     // Reset all trackers to unused state
     for (int i = 0; i < MAX_TIMESTAMP_TRACKERS; i++) {
+        clear_tracker_state(&timestamp_trackers[i]);
         timestamp_trackers[i].initialized = false;
-        timestamp_trackers[i].stream_name[0] = '\0';
-        timestamp_trackers[i].last_pts = AV_NOPTS_VALUE;
-        timestamp_trackers[i].last_dts = AV_NOPTS_VALUE;
-        timestamp_trackers[i].pts_discontinuity_count = 0;
-        timestamp_trackers[i].expected_next_pts = AV_NOPTS_VALUE;
         timestamp_trackers[i].is_udp_stream = false;
-        timestamp_trackers[i].last_keyframe_time = 0;
-        timestamp_trackers[i].last_detection_time = 0;
+        timestamp_trackers[i].stream_name[0] = '\0';
     }
-    
+
+    pthread_mutex_unlock(&trackers_mutex);
+
     log_info("All timestamp trackers cleaned up");
 }
 
+/**
+ * Update the last keyframe time of a tracker
+ */
+void timestamp_tracker_update_keyframe_time(timestamp_tracker_t *tracker) {
+    if (!tracker) {
+        return;
+    }
+
+    time_t prev_keyframe_time = tracker->last_keyframe_time;
+    tracker->last_keyframe_time = time(NULL);
+
+    // Only log at debug level to avoid filling logs
+    log_debug("Updated keyframe time for stream %s: previous=%ld, new=%ld, delta=%ld seconds",
+            tracker->stream_name,
+            (long)prev_keyframe_time,
+            (long)tracker->last_keyframe_time,
+            prev_keyframe_time > 0 ? (long)(tracker->last_keyframe_time - prev_keyframe_time) : 0);
+}
+
 /**
  * Update the last keyframe time for a stream
  * This should be called when a keyframe is received
@@ -294,93 +281,63 @@ void update_keyframe_time(const char *stream_name) {
         return;
     }
 
-    // Find the tracker for this stream
-    bool found = false;
-    for (int i = 0; i < MAX_TIMESTAMP_TRACKERS; i++) {
-        if (timestamp_trackers[i].initialized && 
-            strcmp(timestamp_trackers[i].stream_name, stream_name) == 0) {
-            // Enhanced logging for keyframe tracking
-            time_t prev_keyframe_time = timestamp_trackers[i].last_keyframe_time;
-            timestamp_trackers[i].last_keyframe_time = time(NULL);
-            
-            // Only log at debug level to avoid filling logs
-            log_debug("Updated keyframe time for stream %s: previous=%ld, new=%ld, delta=%ld seconds", 
-                    stream_name, 
-                    (long)prev_keyframe_time, 
-                    (long)timestamp_trackers[i].last_keyframe_time,
-                    prev_keyframe_time > 0 ? (long)(timestamp_trackers[i].last_keyframe_time - prev_keyframe_time) : 0);
-            found = true;
-            break;
-        }
+    timestamp_tracker_t *tracker = get_timestamp_tracker(stream_name);
+    if (!tracker) {
+        log_error("Failed to find or create timestamp tracker for stream %s", stream_name);
+        return;
     }
-    
-    if (!found) {
-        // Create a new tracker if it doesn't exist
-        bool created = false;
-        for (int i = 0; i < MAX_TIMESTAMP_TRACKERS; i++) {
-            if (!timestamp_trackers[i].initialized) {
-                strncpy(timestamp_trackers[i].stream_name, stream_name, MAX_STREAM_NAME - 1);
-                timestamp_trackers[i].stream_name[MAX_STREAM_NAME - 1] = '\0';
-                timestamp_trackers[i].last_pts = AV_NOPTS_VALUE;
-                timestamp_trackers[i].last_dts = AV_NOPTS_VALUE;
-                timestamp_trackers[i].pts_discontinuity_count = 0;
-                timestamp_trackers[i].expected_next_pts = AV_NOPTS_VALUE;
-                timestamp_trackers[i].is_udp_stream = false;
-                timestamp_trackers[i].last_keyframe_time = time(NULL);
-                timestamp_trackers[i].last_detection_time = 0;
-                timestamp_trackers[i].initialized = true;
-                
-                log_info("Created new timestamp tracker for stream %s with keyframe time %ld", 
-                        stream_name, (long)timestamp_trackers[i].last_keyframe_time);
-                created = true;
-                break;
-            }
+
+    timestamp_tracker_update_keyframe_time(tracker);
+}
+
+/**
+ * Check if a keyframe was received by a tracker after a specific time
+ *
+ * BUGFIX: Fixed the function to properly handle the rotation check
+ * The keyframe_time parameter is used both as input (check time) and output (last keyframe time)
+ */
+int timestamp_tracker_keyframe_received(timestamp_tracker_t *tracker, time_t *keyframe_time) {
+    if (!tracker) {
+        // If keyframe_time is not NULL, set it to 0
+        if (keyframe_time) {
+            *keyframe_time = 0;
         }
-        
-        // If we couldn't create a new tracker, try to reuse an existing one
-        if (!created) {
-            // Find the oldest tracker (with the oldest keyframe time)
-            int oldest_idx = -1;
-            time_t oldest_time = time(NULL);
-            
-            for (int i = 0; i < MAX_TIMESTAMP_TRACKERS; i++) {
-                if (timestamp_trackers[i].initialized && 
-                    timestamp_trackers[i].last_keyframe_time < oldest_time) {
-                    oldest_time = timestamp_trackers[i].last_keyframe_time;
-                    oldest_idx = i;
-                }
-            }
-            
-            if (oldest_idx >= 0) {
-                log_warn("Reusing oldest timestamp tracker (from stream %s, last keyframe %ld seconds ago) for stream %s",
-                        timestamp_trackers[oldest_idx].stream_name, 
-                        (long)(time(NULL) - timestamp_trackers[oldest_idx].last_keyframe_time),
-                        stream_name);
-                
-                // Reset the tracker for the new stream
-                strncpy(timestamp_trackers[oldest_idx].stream_name, stream_name, MAX_STREAM_NAME - 1);
-                timestamp_trackers[oldest_idx].stream_name[MAX_STREAM_NAME - 1] = '\0';
-                timestamp_trackers[oldest_idx].last_pts = AV_NOPTS_VALUE;
-                timestamp_trackers[oldest_idx].last_dts = AV_NOPTS_VALUE;
-                timestamp_trackers[oldest_idx].pts_discontinuity_count = 0;
-                timestamp_trackers[oldest_idx].expected_next_pts = AV_NOPTS_VALUE;
-                timestamp_trackers[oldest_idx].is_udp_stream = false;
-                timestamp_trackers[oldest_idx].last_keyframe_time = time(NULL);
-                timestamp_trackers[oldest_idx].last_detection_time = 0;
-            } else {
-                log_error("Failed to find or create timestamp tracker for stream %s", stream_name);
-            }
+        return 0;
+    }
+
+    // Get the check time from keyframe_time parameter (if provided)
+    time_t check_time = 0;
+    if (keyframe_time && *keyframe_time > 0) {
+        check_time = *keyframe_time;
+    }
+
+    // Store the last keyframe time for this stream
+    time_t last_kf_time = tracker->last_keyframe_time;
+
+    // If keyframe_time is not NULL, set it to the time of the last keyframe (output)
+    if (keyframe_time) {
+        *keyframe_time = last_kf_time;
+    }
+
+    // Check if a keyframe was received after the check_time
+    int result = 0;
+    if (last_kf_time > 0) {
+        if (check_time == 0 || last_kf_time > check_time) {
+            result = 1;
         }
     }
+
+    // Log the result for debugging
+    log_debug("Keyframe check for stream %s: last_keyframe_time=%ld, check_time=%ld, result=%d",
+            tracker->stream_name, (long)last_kf_time, (long)check_time, result);
+
+    return result;
 }
 
 /**
  * Check if a keyframe was received for a stream after a specific time
  * Returns 1 if a keyframe was received after the specified time, 0 otherwise
  * If keyframe_time is not NULL, it will be set to the time of the last keyframe
- * 
- * BUGFIX: Fixed the function to properly handle the rotation check
- * The keyframe_time parameter is used both as input (check time) and output (last keyframe time)
  */
 int last_keyframe_received(const char *stream_name, time_t *keyframe_time) {
     if (!stream_name) {
@@ -388,75 +345,19 @@ int last_keyframe_received(const char *stream_name, time_t *keyframe_time) {
         return 0;
     }
 
-    // Find the tracker for this stream
-    for (int i = 0; i < MAX_TIMESTAMP_TRACKERS; i++) {
-        if (timestamp_trackers[i].initialized && 
-            strcmp(timestamp_trackers[i].stream_name, stream_name) == 0) {
-            
-            // Get the check time from keyframe_time parameter (if provided)
-            time_t check_time = 0;
-            if (keyframe_time && *keyframe_time > 0) {
-                check_time = *keyframe_time;
-            }
-            
-            // Store the last keyframe time for this stream
-            time_t last_kf_time = timestamp_trackers[i].last_keyframe_time;
-            
-            // If keyframe_time is not NULL, set it to the time of the last keyframe (output)
-            if (keyframe_time) {
-                *keyframe_time = last_kf_time;
-            }
-            
-            // Check if a keyframe was received after the check_time
-            int result = 0;
-            if (last_kf_time > 0) {
-                if (check_time == 0 || last_kf_time > check_time) {
-                    result = 1;
-                }
-            }
-            
-            // Log the result for debugging
-            log_debug("Keyframe check for stream %s: last_keyframe_time=%ld, check_time=%ld, result=%d", 
-                    stream_name, (long)last_kf_time, (long)check_time, result);
-            
-            return result;
-        }
-    }
-    
-    // No tracker found for this stream, create one
-    for (int i = 0; i < MAX_TIMESTAMP_TRACKERS; i++) {
-        if (!timestamp_trackers[i].initialized) {
-            log_info("Creating new timestamp tracker for stream %s during keyframe check", stream_name);
-            
-            strncpy(timestamp_trackers[i].stream_name, stream_name, MAX_STREAM_NAME - 1);
-            timestamp_trackers[i].stream_name[MAX_STREAM_NAME - 1] = '\0';
-            timestamp_trackers[i].last_pts = AV_NOPTS_VALUE;
-            timestamp_trackers[i].last_dts = AV_NOPTS_VALUE;
-            timestamp_trackers[i].pts_discontinuity_count = 0;
-            timestamp_trackers[i].expected_next_pts = AV_NOPTS_VALUE;
-            timestamp_trackers[i].is_udp_stream = false;
-            timestamp_trackers[i].last_keyframe_time = 0; // No keyframe yet
-            timestamp_trackers[i].last_detection_time = 0; // No detection yet
-            timestamp_trackers[i].initialized = true;
-            
-            // If keyframe_time is not NULL, set it to 0
-            if (keyframe_time) {
-                *keyframe_time = 0;
-            }
-            
-            return 0; // No keyframe yet
-        }
+    timestamp_tracker_t *tracker = get_timestamp_tracker(stream_name);
+    if (!tracker) {
+        log_warn("No timestamp tracker found for stream %s during last_keyframe_received and couldn't create one", stream_name);
     }
 
-    // No tracker found and couldn't create one
-    log_warn("No timestamp tracker found for stream %s during last_keyframe_received and couldn't create one", stream_name);
-    
-    // If keyframe_time is not NULL, set it to 0
-    if (keyframe_time) {
-        *keyframe_time = 0;
-    }
-    
-    return 0;
+    return timestamp_tracker_keyframe_received(tracker, keyframe_time);
+}
+
+/**
+ * Get the last detection time of a tracker
+ */
+time_t timestamp_tracker_get_last_detection_time(timestamp_tracker_t *tracker) {
+    return tracker ? tracker->last_detection_time : 0;
 }
 
 /**
@@ -469,46 +370,37 @@ time_t get_last_detection_time(const char *stream_name) {
         return 0;
     }
 
-    // Find the tracker for this stream
-    for (int i = 0; i < MAX_TIMESTAMP_TRACKERS; i++) {
-        if (timestamp_trackers[i].initialized && 
-            strcmp(timestamp_trackers[i].stream_name, stream_name) == 0) {
-            
-            // Get the last detection time
-            time_t last_detection_time = timestamp_trackers[i].last_detection_time;
-            
-            // Log the result for debugging
-            log_debug("Last detection time for stream %s: %ld", 
-                    stream_name, (long)last_detection_time);
-            
-            return last_detection_time;
-        }
+    timestamp_tracker_t *tracker = get_timestamp_tracker(stream_name);
+    if (!tracker) {
+        log_warn("No timestamp tracker found for stream %s during get_last_detection_time and couldn't create one", stream_name);
+        return 0;
     }
-    
-    // No tracker found for this stream, create one
-    for (int i = 0; i < MAX_TIMESTAMP_TRACKERS; i++) {
-        if (!timestamp_trackers[i].initialized) {
-            log_info("Creating new timestamp tracker for stream %s during get_last_detection_time", stream_name);
-            
-            strncpy(timestamp_trackers[i].stream_name, stream_name, MAX_STREAM_NAME - 1);
-            timestamp_trackers[i].stream_name[MAX_STREAM_NAME - 1] = '\0';
-            timestamp_trackers[i].last_pts = AV_NOPTS_VALUE;
-            timestamp_trackers[i].last_dts = AV_NOPTS_VALUE;
-            timestamp_trackers[i].pts_discontinuity_count = 0;
-            timestamp_trackers[i].expected_next_pts = AV_NOPTS_VALUE;
-            timestamp_trackers[i].is_udp_stream = false;
-            timestamp_trackers[i].last_keyframe_time = 0; // No keyframe yet
-            timestamp_trackers[i].last_detection_time = 0; // No detection yet
-            timestamp_trackers[i].initialized = true;
-            
-            return 0; // No detection yet
-        }
+
+    time_t last_detection_time = timestamp_tracker_get_last_detection_time(tracker);
+
+    // Log the result for debugging
+    log_debug("Last detection time for stream %s: %ld", stream_name, (long)last_detection_time);
+
+    return last_detection_time;
+}
+
+/**
+ * Update the last detection time of a tracker
+ */
+void timestamp_tracker_update_last_detection_time(timestamp_tracker_t *tracker, time_t detection_time) {
+    if (!tracker) {
+        return;
     }
 
-    // No tracker found and couldn't create one
-    log_warn("No timestamp tracker found for stream %s during get_last_detection_time and couldn't create one", stream_name);
-    
-    return 0;
+    time_t prev_detection_time = tracker->last_detection_time;
+    tracker->last_detection_time = detection_time;
+
+    // Only log at debug level to avoid filling logs
+    log_debug("Updated detection time for stream %s: previous=%ld, new=%ld, delta=%ld seconds",
+            tracker->stream_name,
+            (long)prev_detection_time,
+            (long)tracker->last_detection_time,
+            prev_detection_time > 0 ? (long)(tracker->last_detection_time - prev_detection_time) : 0);
 }
 
 /**
@@ -521,82 +413,11 @@ void update_last_detection_time(const char *stream_name, time_t detection_time)
         return;
     }
 
-    // Find the tracker for this stream
-    bool found = false;
-    for (int i = 0; i < MAX_TIMESTAMP_TRACKERS; i++) {
-        if (timestamp_trackers[i].initialized && 
-            strcmp(timestamp_trackers[i].stream_name, stream_name) == 0) {
-            // Enhanced logging for detection tracking
-            time_t prev_detection_time = timestamp_trackers[i].last_detection_time;
-            timestamp_trackers[i].last_detection_time = detection_time;
-            
-            // Only log at debug level to avoid filling logs
-            log_debug("Updated detection time for stream %s: previous=%ld, new=%ld, delta=%ld seconds", 
-                    stream_name, 
-                    (long)prev_detection_time, 
-                    (long)timestamp_trackers[i].last_detection_time,
-                    prev_detection_time > 0 ? (long)(timestamp_trackers[i].last_detection_time - prev_detection_time) : 0);
-            found = true;
-            break;
-        }
-    }
-    
-    if (!found) {
-        // Create a new tracker if it doesn't exist
-        bool created = false;
-        for (int i = 0; i < MAX_TIMESTAMP_TRACKERS; i++) {
-            if (!timestamp_trackers[i].initialized) {
-                strncpy(timestamp_trackers[i].stream_name, stream_name, MAX_STREAM_NAME - 1);
-                timestamp_trackers[i].stream_name[MAX_STREAM_NAME - 1] = '\0';
-                timestamp_trackers[i].last_pts = AV_NOPTS_VALUE;
-                timestamp_trackers[i].last_dts = AV_NOPTS_VALUE;
-                timestamp_trackers[i].pts_discontinuity_count = 0;
-                timestamp_trackers[i].expected_next_pts = AV_NOPTS_VALUE;
-                timestamp_trackers[i].is_udp_stream = false;
-                timestamp_trackers[i].last_keyframe_time = 0;
-                timestamp_trackers[i].last_detection_time = detection_time;
-                timestamp_trackers[i].initialized = true;
-                
-                log_info("Created new timestamp tracker for stream %s with detection time %ld", 
-                        stream_name, (long)timestamp_trackers[i].last_detection_time);
-                created = true;
-                break;
-            }
-        }
-        
-        // If we couldn't create a new tracker, try to reuse an existing one
-        if (!created) {
-            // Find the oldest tracker (with the oldest keyframe time)
-            int oldest_idx = -1;
-            time_t oldest_time = time(NULL);
-            
-            for (int i = 0; i < MAX_TIMESTAMP_TRACKERS; i++) {
-                if (timestamp_trackers[i].initialized && 
-                    timestamp_trackers[i].last_keyframe_time < oldest_time) {
-                    oldest_time = timestamp_trackers[i].last_keyframe_time;
-                    oldest_idx = i;
-                }
-            }
-            
-            if (oldest_idx >= 0) {
-                log_warn("Reusing oldest timestamp tracker (from stream %s, last keyframe %ld seconds ago) for stream %s",
-                        timestamp_trackers[oldest_idx].stream_name, 
-                        (long)(time(NULL) - timestamp_trackers[oldest_idx].last_keyframe_time),
-                        stream_name);
-                
-                // Reset the tracker for the new stream
-                strncpy(timestamp_trackers[oldest_idx].stream_name, stream_name, MAX_STREAM_NAME - 1);
-                timestamp_trackers[oldest_idx].stream_name[MAX_STREAM_NAME - 1] = '\0';
-                timestamp_trackers[oldest_idx].last_pts = AV_NOPTS_VALUE;
-                timestamp_trackers[oldest_idx].last_dts = AV_NOPTS_VALUE;
-                timestamp_trackers[oldest_idx].pts_discontinuity_count = 0;
-                timestamp_trackers[oldest_idx].expected_next_pts = AV_NOPTS_VALUE;
-                timestamp_trackers[oldest_idx].is_udp_stream = false;
-                timestamp_trackers[oldest_idx].last_keyframe_time = 0;
-                timestamp_trackers[oldest_idx].last_detection_time = detection_time;
-            } else {
-                log_error("Failed to find or create timestamp tracker for stream %s", stream_name);
-            }
-        }
+    timestamp_tracker_t *tracker = get_timestamp_tracker(stream_name);
+    if (!tracker) {
+        log_error("Failed to find or create timestamp tracker for stream %s", stream_name);
+        return;
     }
+
+    timestamp_tracker_update_last_detection_time(tracker, detection_time);
 }
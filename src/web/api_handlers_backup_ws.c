@@ -0,0 +1,90 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "web/api_handlers_backup_ws.h"
+#include "web/websocket_client.h"
+#include "web/websocket_manager.h"
+#include "web/mongoose_server_websocket_utils.h"
+#include "core/logger.h"
+#include "cJSON.h"
+
+static char *backup_payload(const db_backup_status_t *status) {
+    cJSON *payload = cJSON_CreateObject();
+    if (!payload) {
+        return NULL;
+    }
+    cJSON_AddStringToObject(payload, "state", backup_state_name(status->state));
+    cJSON_AddNumberToObject(payload, "started_at", (double)status->started_at);
+    cJSON_AddNumberToObject(payload, "finished_at", (double)status->finished_at);
+    cJSON_AddNumberToObject(payload, "pages_done", status->pages_done);
+    cJSON_AddNumberToObject(payload, "pages_total", status->pages_total);
+    cJSON_AddBoolToObject(payload, "compressed", status->compressed);
+    cJSON_AddNumberToObject(payload, "size", (double)status->size);
+    cJSON_AddStringToObject(payload, "message", status->message);
+
+    char *str = cJSON_PrintUnformatted(payload);
+    cJSON_Delete(payload);
+    return str;
+}
+
+void publish_backup_progress(const db_backup_status_t *status) {
+    if (!status) {
+        return;
+    }
+
+    char *payload = backup_payload(status);
+    if (!payload) {
+        return;
+    }
+    char *message = mg_websocket_message_create("progress", BACKUP_TOPIC, payload);
+    free(payload);
+    if (!message) {
+        return;
+    }
+
+    // Each update replaces the previous one, so a slow client only misses steps
+    websocket_manager_publish(BACKUP_TOPIC, message, strlen(message), WS_DROP_OLDEST);
+    mg_websocket_message_free(message);
+}
+
+void websocket_handle_backup(const char *client_id, const char *message) {
+    if (!client_id || !message) {
+        log_error("Invalid parameters for websocket_handle_backup");
+        return;
+    }
+
+    cJSON *json = cJSON_Parse(message);
+    if (!json) {
+        log_error("Failed to parse backup WebSocket message");
+        return;
+    }
+
+    cJSON *type = cJSON_GetObjectItem(json, "type");
+    if (!type || !cJSON_IsString(type)) {
+        log_warn("Invalid backup WebSocket message from client %s", client_id);
+        cJSON_Delete(json);
+        return;
+    }
+
+    if (strcmp(type->valuestring, "subscribe") == 0) {
+        if (websocket_client_subscribe(client_id, BACKUP_TOPIC)) {
+            // A client subscribing mid-backup sees where it is right away
+            db_backup_status_t status;
+            get_backup_status(&status);
+            char *payload = backup_payload(&status);
+            char *ack = payload ? mg_websocket_message_create("ack", BACKUP_TOPIC, payload) : NULL;
+            free(payload);
+            if (ack) {
+                mg_websocket_message_send_to_client(client_id, ack);
+                mg_websocket_message_free(ack);
+            }
+        }
+    } else if (strcmp(type->valuestring, "unsubscribe") == 0) {
+        websocket_client_unsubscribe(client_id, BACKUP_TOPIC);
+    } else {
+        log_debug("Ignoring backup WebSocket message of type %s", type->valuestring);
+    }
+
+    cJSON_Delete(json);
+}
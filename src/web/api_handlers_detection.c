@@ -11,6 +11,7 @@
 
 #include "web/api_handlers.h"
 #include "web/mongoose_adapter.h"
+#include "web/json_writer.h"
 #include "core/logger.h"
 #include "core/config.h"
 #include "mongoose.h"
@@ -18,10 +19,15 @@
 #include "video/detection_result.h"
 #include "video/stream_manager.h"
 #include "database/database_manager.h"
+#include "database/db_detections.h"
+#include "database/db_detection_search.h"
 
 // Maximum age of detections to return (in seconds)
 #define MAX_DETECTION_AGE 60
 
+// Results per search page unless limit is given
+#define DEFAULT_SEARCH_LIMIT 50
+
 /**
  * @brief Direct handler for GET /api/detection/results/:stream
  */
@@ -90,68 +96,244 @@ void mg_handle_get_detection_results(struct mg_connection *c, struct mg_http_mes
         return;
     }
     
-    // Create JSON response
-    cJSON *response = cJSON_CreateObject();
-    if (!response) {
-        log_error("Failed to create response JSON object");
-        mg_send_json_error(c, 500, "Failed to create response JSON");
-        return;
-    }
+    // Stream the response; no JSON tree or string is built
+    json_writer_t writer;
+    json_writer_t *w = &writer;
+    json_writer_begin(w, c, 200);
+    json_write_object_start(w, NULL);
+    json_write_array_start(w, "detections");
     
-    // Create detections array
-    cJSON *detections_array = cJSON_CreateArray();
-    if (!detections_array) {
-        log_error("Failed to create detections JSON array");
-        cJSON_Delete(response);
-        mg_send_json_error(c, 500, "Failed to create detections JSON");
-        return;
+    // Add each detection to the array
+    for (int i = 0; i < result.count; i++) {
+        json_write_object_start(w, NULL);
+        json_write_string(w, "label", result.detections[i].label);
+        json_write_number(w, "confidence", result.detections[i].confidence);
+        json_write_number(w, "x", result.detections[i].x);
+        json_write_number(w, "y", result.detections[i].y);
+        json_write_number(w, "width", result.detections[i].width);
+        json_write_number(w, "height", result.detections[i].height);
+        json_write_number(w, "timestamp", (double)timestamps[i]);
+        json_write_number(w, "track_id", result.detections[i].track_id);
+        json_write_object_end(w);
     }
     
-    // Add detections array to response
-    cJSON_AddItemToObject(response, "detections", detections_array);
+    json_write_array_end(w);
     
     // Add timestamp
-    char timestamp[32];
+    char timestamp[32] = {0};
     time_t now = time(NULL);
-    struct tm *tm_info = localtime(&now);
-    strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", tm_info);
-    cJSON_AddStringToObject(response, "timestamp", timestamp);
-    
-    // Add each detection to the array
-    for (int i = 0; i < result.count; i++) {
-        cJSON *detection = cJSON_CreateObject();
-        if (!detection) {
-            log_error("Failed to create detection JSON object");
-            continue;
-        }
-        
-        // Add detection properties
-        cJSON_AddStringToObject(detection, "label", result.detections[i].label);
-        cJSON_AddNumberToObject(detection, "confidence", result.detections[i].confidence);
-        cJSON_AddNumberToObject(detection, "x", result.detections[i].x);
-        cJSON_AddNumberToObject(detection, "y", result.detections[i].y);
-        cJSON_AddNumberToObject(detection, "width", result.detections[i].width);
-        cJSON_AddNumberToObject(detection, "height", result.detections[i].height);
-        cJSON_AddNumberToObject(detection, "timestamp", (double)timestamps[i]);
-        
-        cJSON_AddItemToArray(detections_array, detection);
-    }
-    
-    // Convert to string
-    char *json_str = cJSON_PrintUnformatted(response);
-    if (!json_str) {
-        log_error("Failed to convert response JSON to string");
-        cJSON_Delete(response);
-        mg_send_json_error(c, 500, "Failed to convert response JSON to string");
-        return;
+    struct tm tm_buf;
+    if (localtime_r(&now, &tm_buf)) {
+        strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", &tm_buf);
     }
+    json_write_string(w, "timestamp", timestamp);
     
-    // Send response
-    mg_send_json_response(c, 200, json_str);
-    
-    // Clean up
-    free(json_str);
-    cJSON_Delete(response);
+    json_write_object_end(w);
+    json_writer_end(w);
     
     log_info("Successfully handled GET /api/detection/results/%s request", stream_name);
 }
+
+/**
+ * @brief Direct handler for POST /api/detection/results/:stream
+ *
+ * Stores detections made by an external process, e.g. one reading the stream
+ * from the shared-memory frame export, next to the stream's own detections.
+ */
+void mg_handle_post_detection_results(struct mg_connection *c, struct mg_http_message *hm) {
+    char stream_name[MAX_STREAM_NAME];
+    if (mg_extract_path_param(hm, "/api/detection/results/", stream_name, sizeof(stream_name)) != 0) {
+        log_error("Failed to extract stream name from URL");
+        mg_send_json_error(c, 400, "Invalid request path");
+        return;
+    }
+
+    log_debug("Handling POST /api/detection/results/%s request", stream_name);
+
+    if (!get_stream_by_name(stream_name)) {
+        log_error("Stream not found: %s", stream_name);
+        mg_send_json_error(c, 404, "Stream not found");
+        return;
+    }
+
+    cJSON *root = mg_parse_json_body(hm);
+    if (!root) {
+        log_error("Invalid JSON request");
+        mg_send_json_error(c, 400, "Invalid JSON request");
+        return;
+    }
+
+    cJSON *detections = cJSON_GetObjectItem(root, "detections");
+    if (!detections || !cJSON_IsArray(detections)) {
+        cJSON_Delete(root);
+        mg_send_json_error(c, 400, "Missing detections array");
+        return;
+    }
+
+    time_t timestamp = time(NULL);
+    cJSON *timestamp_item = cJSON_GetObjectItem(root, "timestamp");
+    if (timestamp_item && cJSON_IsNumber(timestamp_item) && timestamp_item->valuedouble > 0) {
+        timestamp = (time_t)timestamp_item->valuedouble;
+    }
+
+    detection_result_t result;
+    memset(&result, 0, sizeof(detection_result_t));
+
+    cJSON *item;
+    cJSON_ArrayForEach(item, detections) {
+        if (result.count >= MAX_DETECTIONS) {
+            log_warn("Only the first %d posted detections of %s are stored", MAX_DETECTIONS, stream_name);
+            break;
+        }
+
+        cJSON *label = cJSON_GetObjectItem(item, "label");
+        cJSON *confidence = cJSON_GetObjectItem(item, "confidence");
+        cJSON *x = cJSON_GetObjectItem(item, "x");
+        cJSON *y = cJSON_GetObjectItem(item, "y");
+        cJSON *width = cJSON_GetObjectItem(item, "width");
+        cJSON *height = cJSON_GetObjectItem(item, "height");
+        if (!label || !cJSON_IsString(label) || !confidence || !cJSON_IsNumber(confidence) ||
+            !x || !cJSON_IsNumber(x) || !y || !cJSON_IsNumber(y) ||
+            !width || !cJSON_IsNumber(width) || !height || !cJSON_IsNumber(height)) {
+            cJSON_Delete(root);
+            mg_send_json_error(c, 400, "Detections need label, confidence, x, y, width and height");
+            return;
+        }
+
+        detection_t *detection = &result.detections[result.count++];
+        strncpy(detection->label, label->valuestring, MAX_LABEL_LENGTH - 1);
+        detection->label[MAX_LABEL_LENGTH - 1] = '\0';
+        detection->confidence = (float)confidence->valuedouble;
+        detection->x = (float)x->valuedouble;
+        detection->y = (float)y->valuedouble;
+        detection->width = (float)width->valuedouble;
+        detection->height = (float)height->valuedouble;
+    }
+    cJSON_Delete(root);
+
+    if (result.count > 0 && store_detections_in_db(stream_name, &result, timestamp) != 0) {
+        log_error("Failed to store posted detections for stream: %s", stream_name);
+        mg_send_json_error(c, 500, "Failed to store detections");
+        return;
+    }
+
+    char response[64];
+    snprintf(response, sizeof(response), "{\"success\":true,\"stored\":%d}", result.count);
+    mg_send_json_response(c, 200, response);
+}
+
+/**
+ * @brief Direct handler for GET /api/detection/search
+ *
+ * Detections of a label across streams, newest first. Takes label, and
+ * optionally stream (comma-separated names), start and end (Unix seconds),
+ * min_confidence, limit and the cursor returned with the previous page.
+ */
+void mg_handle_get_detection_search(struct mg_connection *c, struct mg_http_message *hm) {
+    char label[MAX_LABEL_LENGTH] = {0};
+    char streams[1024] = {0};
+    char value[64];
+
+    if (mg_http_get_var(&hm->query, "label", label, sizeof(label)) <= 0) {
+        mg_send_json_error(c, 400, "Missing label");
+        return;
+    }
+
+    detection_search_query_t query = {0};
+    query.label = label;
+    query.end_time = time(NULL);
+    query.limit = DEFAULT_SEARCH_LIMIT;
+    if (mg_http_get_var(&hm->query, "stream", streams, sizeof(streams)) > 0) {
+        query.streams = streams;
+    }
+    if (mg_http_get_var(&hm->query, "start", value, sizeof(value)) > 0) {
+        query.start_time = (time_t)strtoll(value, NULL, 10);
+    }
+    if (mg_http_get_var(&hm->query, "end", value, sizeof(value)) > 0) {
+        query.end_time = (time_t)strtoll(value, NULL, 10);
+    }
+    if (mg_http_get_var(&hm->query, "min_confidence", value, sizeof(value)) > 0) {
+        query.min_confidence = strtof(value, NULL);
+    }
+    if (mg_http_get_var(&hm->query, "limit", value, sizeof(value)) > 0) {
+        query.limit = atoi(value);
+    }
+    if (query.limit <= 0 || query.limit > DETECTION_SEARCH_MAX_RESULTS) {
+        mg_send_json_error(c, 400, "Invalid limit");
+        return;
+    }
+    if (query.end_time < query.start_time) {
+        mg_send_json_error(c, 400, "End time must not be before start time");
+        return;
+    }
+
+    // The cursor is the time of the last result and how many results of
+    // that second were returned
+    if (mg_http_get_var(&hm->query, "cursor", value, sizeof(value)) > 0) {
+        long long cursor_time = 0;
+        int cursor_skip = 0;
+        if (sscanf(value, "%lld-%d", &cursor_time, &cursor_skip) != 2 || cursor_time <= 0 || cursor_skip < 0) {
+            mg_send_json_error(c, 400, "Invalid cursor");
+            return;
+        }
+        query.cursor_time = (time_t)cursor_time;
+        query.cursor_skip = cursor_skip;
+    }
+
+    detection_search_result_t *results = malloc((size_t)query.limit * sizeof(detection_search_result_t));
+    if (!results) {
+        mg_send_json_error(c, 500, "Failed to allocate memory");
+        return;
+    }
+
+    time_t next_time;
+    int next_skip;
+    bool more;
+    int count = search_detections(&query, results, &next_time, &next_skip, &more);
+    if (count < 0) {
+        free(results);
+        mg_send_json_error(c, 500, "Failed to search detections");
+        return;
+    }
+
+    json_writer_t writer;
+    json_writer_t *w = &writer;
+    json_writer_begin(w, c, 200);
+    json_write_object_start(w, NULL);
+    json_write_string(w, "label", label);
+    json_write_array_start(w, "results");
+    for (int i = 0; i < count; i++) {
+        const detection_search_result_t *r = &results[i];
+        json_write_object_start(w, NULL);
+        json_write_string(w, "stream", r->stream_name);
+        json_write_number(w, "timestamp", (double)r->timestamp);
+        json_write_string(w, "label", r->detection.label);
+        json_write_number(w, "confidence", r->detection.confidence);
+        json_write_number(w, "x", r->detection.x);
+        json_write_number(w, "y", r->detection.y);
+        json_write_number(w, "width", r->detection.width);
+        json_write_number(w, "height", r->detection.height);
+        json_write_number(w, "track_id", r->detection.track_id);
+        if (r->recording_id > 0) {
+            json_write_number(w, "recording_id", (double)r->recording_id);
+            json_write_number(w, "recording_offset", (double)(r->timestamp - r->recording_start));
+        } else {
+            json_write_null(w, "recording_id");
+        }
+        json_write_object_end(w);
+    }
+    json_write_array_end(w);
+
+    if (more) {
+        char cursor[48];
+        snprintf(cursor, sizeof(cursor), "%lld-%d", (long long)next_time, next_skip);
+        json_write_string(w, "next_cursor", cursor);
+    } else {
+        json_write_null(w, "next_cursor");
+    }
+
+    json_write_object_end(w);
+    json_writer_end(w);
+
+    free(results);
+}
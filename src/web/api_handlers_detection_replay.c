@@ -0,0 +1,139 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "web/api_handlers.h"
+#include "web/mongoose_adapter.h"
+#include "core/logger.h"
+#include "core/config.h"
+#include "mongoose.h"
+#include "video/detection_replay.h"
+
+/**
+ * @brief Send the progress of the current or last replay
+ */
+static void send_replay_status(struct mg_connection *c, int status_code) {
+    detection_replay_status_t status;
+    detection_replay_get_status(&status);
+
+    cJSON *response = cJSON_CreateObject();
+    if (!response) {
+        mg_send_json_error(c, 500, "Failed to create JSON response");
+        return;
+    }
+
+    cJSON_AddStringToObject(response, "state", detection_replay_state_name(status.state));
+    if (status.state != DETECTION_REPLAY_IDLE) {
+        cJSON_AddStringToObject(response, "stream", status.request.stream_name);
+        cJSON_AddNumberToObject(response, "start", (double)status.request.start_time);
+        cJSON_AddNumberToObject(response, "end", (double)status.request.end_time);
+        cJSON_AddStringToObject(response, "model", status.request.model_path);
+        cJSON_AddNumberToObject(response, "threshold", status.request.threshold);
+        cJSON_AddNumberToObject(response, "interval", status.request.interval);
+        cJSON_AddBoolToObject(response, "store", status.request.store);
+        cJSON_AddNumberToObject(response, "recordings", status.recordings);
+        cJSON_AddNumberToObject(response, "recordings_failed", status.recordings_failed);
+        cJSON_AddNumberToObject(response, "frames", (double)status.frames);
+        cJSON_AddNumberToObject(response, "detections", (double)status.detections);
+        cJSON_AddNumberToObject(response, "footage_seconds", status.footage_seconds);
+        cJSON_AddNumberToObject(response, "elapsed_seconds", status.elapsed_seconds);
+
+        // Throughput, so the same replay can compare detection changes
+        double elapsed = status.elapsed_seconds > 0 ? status.elapsed_seconds : 0;
+        cJSON_AddNumberToObject(response, "frames_per_second", elapsed > 0 ? (double)status.frames / elapsed : 0);
+        cJSON_AddNumberToObject(response, "speed", elapsed > 0 ? status.footage_seconds / elapsed : 0);
+        if (status.error[0] != '\0') {
+            cJSON_AddStringToObject(response, "error", status.error);
+        }
+    }
+
+    char *json_str = cJSON_PrintUnformatted(response);
+    cJSON_Delete(response);
+    if (!json_str) {
+        mg_send_json_error(c, 500, "Failed to convert replay status to JSON");
+        return;
+    }
+
+    mg_send_json_response(c, status_code, json_str);
+    free(json_str);
+}
+
+/**
+ * @brief Direct handler for GET /api/detection/replay
+ */
+void mg_handle_get_detection_replay(struct mg_connection *c, struct mg_http_message *hm) {
+    (void)hm;
+    send_replay_status(c, 200);
+}
+
+/**
+ * @brief Direct handler for POST /api/detection/replay
+ *
+ * Takes stream, start and end (Unix seconds), and optionally model (a file
+ * in the models directory or a path), threshold, interval (seconds between
+ * the key frames detected on) and store (false to only measure throughput).
+ */
+void mg_handle_post_detection_replay(struct mg_connection *c, struct mg_http_message *hm) {
+    cJSON *root = mg_parse_json_body(hm);
+    if (!root) {
+        mg_send_json_error(c, 400, "Invalid JSON request");
+        return;
+    }
+
+    detection_replay_request_t request;
+    memset(&request, 0, sizeof(request));
+    request.store = true;
+
+    cJSON *stream = cJSON_GetObjectItem(root, "stream");
+    cJSON *start = cJSON_GetObjectItem(root, "start");
+    cJSON *end = cJSON_GetObjectItem(root, "end");
+    if (!stream || !cJSON_IsString(stream) || !start || !cJSON_IsNumber(start) ||
+        !end || !cJSON_IsNumber(end)) {
+        cJSON_Delete(root);
+        mg_send_json_error(c, 400, "Replay needs stream, start and end");
+        return;
+    }
+    snprintf(request.stream_name, sizeof(request.stream_name), "%s", stream->valuestring);
+    request.start_time = (time_t)start->valuedouble;
+    request.end_time = (time_t)end->valuedouble;
+
+    cJSON *model = cJSON_GetObjectItem(root, "model");
+    if (model && cJSON_IsString(model)) {
+        snprintf(request.model_path, sizeof(request.model_path), "%s", model->valuestring);
+    }
+    cJSON *threshold = cJSON_GetObjectItem(root, "threshold");
+    if (threshold && cJSON_IsNumber(threshold)) {
+        request.threshold = (float)threshold->valuedouble;
+    }
+    cJSON *interval = cJSON_GetObjectItem(root, "interval");
+    if (interval && cJSON_IsNumber(interval)) {
+        request.interval = interval->valueint;
+    }
+    cJSON *store = cJSON_GetObjectItem(root, "store");
+    if (store && cJSON_IsBool(store)) {
+        request.store = cJSON_IsTrue(store);
+    }
+    cJSON_Delete(root);
+
+    char error[128];
+    if (detection_replay_start(&request, error, sizeof(error)) != 0) {
+        log_warn("Detection replay of stream %s not started: %s", request.stream_name, error);
+        detection_replay_status_t status;
+        detection_replay_get_status(&status);
+        mg_send_json_error(c, status.state == DETECTION_REPLAY_RUNNING ? 409 : 400, error);
+        return;
+    }
+
+    send_replay_status(c, 202);
+}
+
+/**
+ * @brief Direct handler for DELETE /api/detection/replay
+ */
+void mg_handle_delete_detection_replay(struct mg_connection *c, struct mg_http_message *hm) {
+    (void)hm;
+    detection_replay_cancel();
+    send_replay_status(c, 200);
+}
@@ -74,11 +74,17 @@ void debug_dump_detection_results(void) {
     log_info("DEBUG: Current detection results (from database):");
     
     // Get all stream names
-    stream_config_t streams[MAX_STREAMS];
-    int stream_count = get_all_stream_configs(streams, MAX_STREAMS);
+    stream_config_t *streams = calloc(g_config.max_streams, sizeof(stream_config_t));
+    if (!streams) {
+        log_error("Failed to allocate memory for stream configurations");
+        return;
+    }
+    
+    int stream_count = get_all_stream_configs(streams, g_config.max_streams);
     
     if (stream_count <= 0) {
         log_info("  No streams found");
+        free(streams);
         return;
     }
     
@@ -108,6 +114,8 @@ void debug_dump_detection_results(void) {
         }
     }
     
+    free(streams);
+    
     if (active_streams == 0) {
         log_info("  No active detection results found");
     }
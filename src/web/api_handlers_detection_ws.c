@@ -0,0 +1,148 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "web/api_handlers_detection_ws.h"
+#include "web/websocket_client.h"
+#include "web/websocket_manager.h"
+#include "web/mongoose_server_websocket_utils.h"
+#include "core/logger.h"
+#include "core/event_bus.h"
+#include "cJSON.h"
+
+// Maximum topic name length
+#define MAX_TOPIC_LENGTH 64
+
+// Enough for MAX_DETECTIONS entries with full labels
+#define DETECTIONS_MESSAGE_SIZE 4096
+
+/**
+ * Append a string as a JSON string literal
+ */
+static size_t append_quoted(char *buf, size_t size, size_t pos, const char *s) {
+    if (pos < size) {
+        buf[pos] = '"';
+    }
+    pos++;
+    for (const unsigned char *p = (const unsigned char *)s; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            if (pos + 1 < size) {
+                buf[pos] = '\\';
+                buf[pos + 1] = (char)*p;
+            }
+            pos += 2;
+        } else if (*p >= 0x20) {
+            if (pos < size) {
+                buf[pos] = (char)*p;
+            }
+            pos++;
+        }
+    }
+    if (pos < size) {
+        buf[pos] = '"';
+    }
+    return pos + 1;
+}
+
+void publish_live_detections(const char *stream_name, const detection_result_t *result,
+                             float threshold, int64_t pts) {
+    if (!stream_name || !result) {
+        return;
+    }
+
+    char topic[MAX_TOPIC_LENGTH];
+    if (snprintf(topic, sizeof(topic), DETECTIONS_TOPIC_PREFIX "%s", stream_name) >= (int)sizeof(topic)) {
+        return;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    long long ts = (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+
+    char buf[DETECTIONS_MESSAGE_SIZE];
+    size_t pos = (size_t)snprintf(buf, sizeof(buf), "{\"type\":\"detections\",\"topic\":");
+    pos = append_quoted(buf, sizeof(buf), pos, topic);
+    if (pos < sizeof(buf)) {
+        pos += (size_t)snprintf(buf + pos, sizeof(buf) - pos,
+                                ",\"payload\":{\"ts\":%lld,\"pts\":%lld,\"d\":[", ts, (long long)pts);
+    }
+
+    bool first = true;
+    for (int i = 0; i < result->count && i < MAX_DETECTIONS; i++) {
+        const detection_t *d = &result->detections[i];
+        if (d->confidence < threshold) {
+            continue;
+        }
+        if (pos < sizeof(buf)) {
+            pos += (size_t)snprintf(buf + pos, sizeof(buf) - pos, first ? "[" : ",[");
+        }
+        first = false;
+
+        pos = append_quoted(buf, sizeof(buf), pos, d->label);
+        if (pos < sizeof(buf)) {
+            pos += (size_t)snprintf(buf + pos, sizeof(buf) - pos, ",%.2f,%.4f,%.4f,%.4f,%.4f,%d]",
+                                    d->confidence, d->x, d->y, d->width, d->height, d->track_id);
+        }
+    }
+
+    if (pos < sizeof(buf)) {
+        pos += (size_t)snprintf(buf + pos, sizeof(buf) - pos, "]}}");
+    }
+    if (pos >= sizeof(buf)) {
+        log_warn("Live detections for stream %s do not fit in a message", stream_name);
+        return;
+    }
+
+    // An overlay that misses a frame is redrawn by the next one
+    websocket_manager_publish(topic, buf, pos, WS_DROP_OLDEST);
+}
+
+static void detection_event_handler(const bus_event_t *event, void *ctx) {
+    (void)ctx;
+    publish_live_detections(event->stream_name, &event->result, event->threshold, event->pts);
+}
+
+int start_live_detections(void) {
+    return event_bus_subscribe("live", BUS_EVENT_MASK(BUS_EVENT_DETECTION), 0, detection_event_handler, NULL);
+}
+
+void websocket_handle_detections(const char *client_id, const char *message) {
+    if (!client_id || !message) {
+        log_error("Invalid parameters for websocket_handle_detections");
+        return;
+    }
+
+    cJSON *json = cJSON_Parse(message);
+    if (!json) {
+        log_error("Failed to parse detections WebSocket message");
+        return;
+    }
+
+    cJSON *type = cJSON_GetObjectItem(json, "type");
+    cJSON *topic = cJSON_GetObjectItem(json, "topic");
+    if (!type || !cJSON_IsString(type) || !topic || !cJSON_IsString(topic) ||
+        strncmp(topic->valuestring, DETECTIONS_TOPIC_PREFIX, strlen(DETECTIONS_TOPIC_PREFIX)) != 0 ||
+        strlen(topic->valuestring) >= MAX_TOPIC_LENGTH) {
+        log_warn("Invalid detections WebSocket message from client %s", client_id);
+        cJSON_Delete(json);
+        return;
+    }
+
+    if (strcmp(type->valuestring, "subscribe") == 0) {
+        if (websocket_client_subscribe(client_id, topic->valuestring)) {
+            char *ack = mg_websocket_message_create("ack", topic->valuestring,
+                                                    "{\"message\":\"Subscribed\"}");
+            if (ack) {
+                mg_websocket_message_send_to_client(client_id, ack);
+                mg_websocket_message_free(ack);
+            }
+        }
+    } else if (strcmp(type->valuestring, "unsubscribe") == 0) {
+        websocket_client_unsubscribe(client_id, topic->valuestring);
+    } else {
+        log_debug("Ignoring detections WebSocket message of type %s", type->valuestring);
+    }
+
+    cJSON_Delete(json);
+}
@@ -0,0 +1,528 @@
+/**
+ * @file api_handlers_export.c
+ * @brief Streaming export of recorded clips
+ *
+ * The handler looks up the recordings of the requested range and sends the
+ * response headers; a detached thread then muxes the export into a bounded
+ * ring buffer, blocking while it is full. The event loop moves the buffered
+ * data into chunks whenever the connection's send buffer runs low, so a
+ * slow client slows the muxer down instead of growing memory.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <ctype.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "web/api_handlers_export.h"
+#include "web/api_handlers.h"
+#include "web/http_server.h"
+#include "web/mongoose_server_auth.h"
+#include "web/mongoose_server_limits.h"
+#include "core/logger.h"
+#include "database/db_recordings.h"
+#include "database/db_compaction.h"
+#include "storage/archive_worker.h"
+#include "video/clip_export.h"
+#include "mongoose.h"
+
+// Exports running at the same time, over all event loops
+#define EXPORT_MAX_JOBS 2
+
+#define EXPORT_MAX_STREAMS 16
+#define EXPORT_MAX_RECORDINGS 1000
+
+// Longest range one export may cover
+#define EXPORT_MAX_DURATION (24 * 3600)
+
+// Recordings starting this long before the range are looked up, since they may reach into it
+#define EXPORT_LOOKBACK (3600)
+
+// Data muxed ahead of the client, and the most queued on the connection at
+// once; the connection's send buffer is filled up to mg_send_limit()
+#define EXPORT_BUFFER_SIZE (1024 * 1024)
+#define EXPORT_CHUNK_SIZE (256 * 1024)
+
+/**
+ * Export shared by its muxing thread and the connection
+ * Freed when both have let go of it.
+ */
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    uint8_t *buffer;            // Ring of EXPORT_BUFFER_SIZE bytes
+    size_t head;                // Oldest byte not yet sent
+    size_t len;
+    bool finished;
+    bool failed;
+    bool cancelled;             // The client went away
+    int refs;
+
+    bool zip;
+    time_t start;
+    time_t end;
+    int stream_count;
+    char streams[EXPORT_MAX_STREAMS][64];
+    int first[EXPORT_MAX_STREAMS];      // Recordings of each stream in recordings
+    int count[EXPORT_MAX_STREAMS];
+    recording_metadata_t *recordings;
+} export_job_t;
+
+// Export of a connection, only used from the event loop thread that owns it
+typedef struct {
+    bool used;
+    unsigned long conn_id;
+    export_job_t *job;
+} export_slot_t;
+
+static _Thread_local export_slot_t export_slots[EXPORT_MAX_JOBS];
+static atomic_int active_exports = 0;
+
+static void release_job(export_job_t *job) {
+    pthread_mutex_lock(&job->mutex);
+    bool last = --job->refs == 0;
+    pthread_mutex_unlock(&job->mutex);
+    if (last) {
+        pthread_mutex_destroy(&job->mutex);
+        pthread_cond_destroy(&job->cond);
+        free(job->buffer);
+        free(job->recordings);
+        free(job);
+    }
+}
+
+/**
+ * Append muxed data to the ring, waiting while it is full
+ */
+static int job_write(void *opaque, const uint8_t *data, int size) {
+    export_job_t *job = (export_job_t *)opaque;
+    pthread_mutex_lock(&job->mutex);
+    while (size > 0) {
+        while (job->len == EXPORT_BUFFER_SIZE && !job->cancelled) {
+            pthread_cond_wait(&job->cond, &job->mutex);
+        }
+        if (job->cancelled) {
+            pthread_mutex_unlock(&job->mutex);
+            return -1;
+        }
+
+        size_t tail = (job->head + job->len) % EXPORT_BUFFER_SIZE;
+        size_t n = EXPORT_BUFFER_SIZE - job->len;
+        if (n > EXPORT_BUFFER_SIZE - tail) {
+            n = EXPORT_BUFFER_SIZE - tail;
+        }
+        if (n > (size_t)size) {
+            n = (size_t)size;
+        }
+        memcpy(job->buffer + tail, data, n);
+        job->len += n;
+        data += n;
+        size -= (int)n;
+    }
+    pthread_mutex_unlock(&job->mutex);
+    return 0;
+}
+
+static void *export_thread(void *arg) {
+    export_job_t *job = (export_job_t *)arg;
+
+    clip_export_source_t *sources = malloc(EXPORT_MAX_RECORDINGS * sizeof(clip_export_source_t));
+    clip_export_entry_t entries[EXPORT_MAX_STREAMS];
+    char names[EXPORT_MAX_STREAMS][96];
+    int ret = -1;
+
+    // Archive entries are named after their stream and the start of the range
+    struct tm tm;
+    char stamp[32];
+    localtime_r(&job->start, &tm);
+    strftime(stamp, sizeof(stamp), "%Y%m%d_%H%M%S", &tm);
+
+    if (sources) {
+        int total = 0;
+        for (int s = 0; s < job->stream_count; s++) {
+            for (int i = 0; i < job->count[s]; i++) {
+                const recording_metadata_t *recording = &job->recordings[job->first[s] + i];
+                compacted_recording_t place;
+                bool compacted = get_recording_compaction(recording->id, &place) == 1;
+                sources[total + i].file_path = recording->file_path;
+                sources[total + i].start_time = recording->start_time;
+                sources[total + i].offset_ms = compacted ? place.offset_ms : 0;
+                sources[total + i].duration_ms = compacted ? place.duration_ms : 0;
+            }
+
+            snprintf(names[s], sizeof(names[s]), "%s_%s.mp4", job->streams[s], stamp);
+            entries[s].name = names[s];
+            entries[s].sources = &sources[total];
+            entries[s].count = job->count[s];
+            total += job->count[s];
+        }
+
+        if (job->zip) {
+            ret = clip_export_zip(entries, job->stream_count, job->start, job->end, job_write, job);
+        } else {
+            ret = clip_export_mp4(entries[0].sources, entries[0].count, job->start, job->end, job_write, job);
+        }
+        free(sources);
+    }
+
+    pthread_mutex_lock(&job->mutex);
+    if (ret != 0 && !job->cancelled) {
+        log_warn("Export of %s from %ld to %ld failed", job->streams[0], (long)job->start, (long)job->end);
+    }
+    job->finished = true;
+    job->failed = ret != 0;
+    pthread_mutex_unlock(&job->mutex);
+
+    release_job(job);
+    atomic_fetch_sub(&active_exports, 1);
+    return NULL;
+}
+
+/**
+ * Parse a time given as seconds since the epoch or as local ISO 8601
+ */
+static int parse_export_time(const char *value, time_t *t) {
+    char *end = NULL;
+    long long seconds = strtoll(value, &end, 10);
+    if (end != value && *end == '\0') {
+        *t = (time_t)seconds;
+        return seconds > 0 ? 0 : -1;
+    }
+
+    struct tm tm = {0};
+    const char *rest = strptime(value, "%Y-%m-%dT%H:%M:%S", &tm);
+    if (!rest || (*rest != '\0' && *rest != '.' && *rest != 'Z')) {
+        return -1;
+    }
+    tm.tm_isdst = -1;
+    *t = mktime(&tm);
+    return *t > 0 ? 0 : -1;
+}
+
+/**
+ * Look up the recordings of a stream that overlap the range, in time order
+ *
+ * @return Number of recordings stored at recordings, or -1 on error
+ */
+static int find_export_recordings(const char *stream, time_t start, time_t end,
+                                  recording_metadata_t *recordings, int max_count) {
+    int count = get_recording_metadata_paginated(start - EXPORT_LOOKBACK, end, stream, 0,
+                                                 "start_time", "asc", recordings, max_count, 0);
+    if (count < 0) {
+        return -1;
+    }
+
+    int kept = 0;
+    for (int i = 0; i < count; i++) {
+        struct stat st;
+        if (recordings[i].end_time <= start || recordings[i].start_time >= end ||
+            locate_recording_file(&recordings[i], &st) != 0) {
+            continue;
+        }
+        if (kept != i) {
+            recordings[kept] = recordings[i];
+        }
+        kept++;
+    }
+    return kept;
+}
+
+static export_slot_t *find_slot(const struct mg_connection *c) {
+    for (int i = 0; i < EXPORT_MAX_JOBS; i++) {
+        if (export_slots[i].used && export_slots[i].conn_id == c->id) {
+            return &export_slots[i];
+        }
+    }
+    return NULL;
+}
+
+static void release_slot(struct mg_connection *c, export_slot_t *slot) {
+    if (slot) {
+        release_job(slot->job);
+        slot->used = false;
+        slot->job = NULL;
+    }
+    c->data[0] = '\0';
+}
+
+/**
+ * Start muxing an export and attach it to the connection
+ * The job is freed, and an error sent, if it cannot be started.
+ *
+ * @return 0 on success, -1 on error
+ */
+static int start_job(struct mg_connection *c, export_job_t *job) {
+    if (atomic_fetch_add(&active_exports, 1) >= EXPORT_MAX_JOBS) {
+        atomic_fetch_sub(&active_exports, 1);
+        free(job->recordings);
+        free(job->buffer);
+        free(job);
+        mg_send_json_error(c, 503, "Too many exports in progress");
+        return -1;
+    }
+
+    export_slot_t *slot = NULL;
+    for (int i = 0; i < EXPORT_MAX_JOBS && !slot; i++) {
+        if (!export_slots[i].used) {
+            slot = &export_slots[i];
+        }
+    }
+
+    pthread_mutex_init(&job->mutex, NULL);
+    pthread_cond_init(&job->cond, NULL);
+    job->refs = 2;
+
+    pthread_t thread;
+    if (!slot || pthread_create(&thread, NULL, export_thread, job) != 0) {
+        log_error("Failed to start export thread");
+        atomic_fetch_sub(&active_exports, 1);
+        job->refs = 1;
+        release_job(job);
+        mg_send_json_error(c, 500, "Failed to start export");
+        return -1;
+    }
+    pthread_detach(thread);
+
+    slot->used = true;
+    slot->conn_id = c->id;
+    slot->job = job;
+    c->data[0] = MG_EXPORT_MARK;
+    return 0;
+}
+
+/**
+ * @brief Handler for GET /api/export
+ */
+void mg_handle_export_clip(struct mg_connection *c, struct mg_http_message *hm) {
+    // Check authentication
+    http_server_t *server = (http_server_t *)c->fn_data;
+    if (server && server->config.auth_enabled) {
+        if (mongoose_server_basic_auth_check(hm, server) != 0) {
+            mg_send_json_error(c, 401, "Unauthorized");
+            return;
+        }
+    }
+
+    char stream_param[1024] = {0};
+    char start_param[64] = {0};
+    char end_param[64] = {0};
+    char format_param[16] = {0};
+    mg_http_get_var(&hm->query, "stream", stream_param, sizeof(stream_param));
+    mg_http_get_var(&hm->query, "start", start_param, sizeof(start_param));
+    mg_http_get_var(&hm->query, "end", end_param, sizeof(end_param));
+    mg_http_get_var(&hm->query, "format", format_param, sizeof(format_param));
+
+    time_t start = 0, end = 0;
+    if (stream_param[0] == '\0' || parse_export_time(start_param, &start) != 0 ||
+        parse_export_time(end_param, &end) != 0) {
+        mg_send_json_error(c, 400, "stream, start and end are required");
+        return;
+    }
+    if (end <= start || end - start > EXPORT_MAX_DURATION) {
+        mg_send_json_error(c, 400, "Invalid export range");
+        return;
+    }
+    bool zip = strcmp(format_param, "zip") == 0;
+    if (format_param[0] != '\0' && !zip && strcmp(format_param, "mp4") != 0) {
+        mg_send_json_error(c, 400, "format must be mp4 or zip");
+        return;
+    }
+
+    export_job_t *job = calloc(1, sizeof(export_job_t));
+    if (!job) {
+        mg_send_json_error(c, 500, "Out of memory");
+        return;
+    }
+    job->zip = zip;
+    job->start = start;
+    job->end = end;
+
+    // Streams are separated by commas
+    char *saveptr = NULL;
+    for (char *name = strtok_r(stream_param, ",", &saveptr); name; name = strtok_r(NULL, ",", &saveptr)) {
+        if (job->stream_count == EXPORT_MAX_STREAMS || strlen(name) >= sizeof(job->streams[0])) {
+            free(job);
+            mg_send_json_error(c, 400, "Too many streams or stream name too long");
+            return;
+        }
+        strcpy(job->streams[job->stream_count++], name);
+    }
+    if (job->stream_count > 1 && !zip) {
+        free(job);
+        mg_send_json_error(c, 400, "Exporting several streams requires format=zip");
+        return;
+    }
+
+    job->recordings = malloc(EXPORT_MAX_RECORDINGS * sizeof(recording_metadata_t));
+    job->buffer = malloc(EXPORT_BUFFER_SIZE);
+    if (!job->recordings || !job->buffer) {
+        free(job->recordings);
+        free(job->buffer);
+        free(job);
+        mg_send_json_error(c, 500, "Out of memory");
+        return;
+    }
+
+    // Streams without recordings in the range are left out of an archive
+    int total = 0;
+    int exported = 0;
+    for (int s = 0; s < job->stream_count; s++) {
+        int count = find_export_recordings(job->streams[s], start, end, &job->recordings[total],
+                                           EXPORT_MAX_RECORDINGS - total);
+        if (count <= 0) {
+            continue;
+        }
+        if (exported != s) {
+            strcpy(job->streams[exported], job->streams[s]);
+        }
+        job->first[exported] = total;
+        job->count[exported] = count;
+        exported++;
+        total += count;
+    }
+    job->stream_count = exported;
+    if (exported == 0) {
+        free(job->recordings);
+        free(job->buffer);
+        free(job);
+        mg_send_json_error(c, 404, "No recordings in the requested range");
+        return;
+    }
+
+    if (start_job(c, job) != 0) {
+        return;
+    }
+
+    // The file name carries the first stream, or says it is a multi-camera archive
+    char safe_name[64];
+    snprintf(safe_name, sizeof(safe_name), "%s", zip ? "export" : job->streams[0]);
+    for (char *p = safe_name; *p; p++) {
+        if (!isalnum((unsigned char)*p) && *p != '-' && *p != '_') {
+            *p = '_';
+        }
+    }
+    struct tm tm;
+    char stamp[32];
+    localtime_r(&start, &tm);
+    strftime(stamp, sizeof(stamp), "%Y%m%d_%H%M%S", &tm);
+
+    log_info("Exporting %d stream(s) from %ld to %ld as %s", exported, (long)start, (long)end,
+             zip ? "ZIP" : "MP4");
+    mg_printf(c,
+              "HTTP/1.1 200 OK\r\n"
+              "Content-Type: %s\r\n"
+              "Content-Disposition: attachment; filename=\"%s_%s.%s\"\r\n"
+              "Cache-Control: no-store\r\n"
+              "Transfer-Encoding: chunked\r\n\r\n",
+              zip ? "application/zip" : "video/mp4", safe_name, stamp, zip ? "zip" : "mp4");
+}
+
+void mg_stream_compacted_recording(struct mg_connection *c, const recording_metadata_t *recording,
+                                   bool attachment) {
+    export_job_t *job = calloc(1, sizeof(export_job_t));
+    if (!job) {
+        mg_send_json_error(c, 500, "Out of memory");
+        return;
+    }
+    job->recordings = malloc(sizeof(recording_metadata_t));
+    job->buffer = malloc(EXPORT_BUFFER_SIZE);
+    if (!job->recordings || !job->buffer) {
+        free(job->recordings);
+        free(job->buffer);
+        free(job);
+        mg_send_json_error(c, 500, "Out of memory");
+        return;
+    }
+
+    // The whole recording, however far it reaches past its end time
+    job->recordings[0] = *recording;
+    job->start = recording->start_time;
+    job->end = (recording->end_time > recording->start_time ? recording->end_time : recording->start_time) + 1;
+    job->stream_count = 1;
+    job->count[0] = 1;
+    snprintf(job->streams[0], sizeof(job->streams[0]), "%s", recording->stream_name);
+
+    if (start_job(c, job) != 0) {
+        return;
+    }
+
+    char disposition[160] = "";
+    if (attachment) {
+        struct tm tm;
+        char stamp[32];
+        localtime_r(&recording->start_time, &tm);
+        strftime(stamp, sizeof(stamp), "%Y%m%d_%H%M%S", &tm);
+        snprintf(disposition, sizeof(disposition),
+                 "Content-Disposition: attachment; filename=\"recording_%s.mp4\"\r\n", stamp);
+    }
+    mg_printf(c,
+              "HTTP/1.1 200 OK\r\n"
+              "Content-Type: video/mp4\r\n"
+              "%s"
+              "Cache-Control: no-store\r\n"
+              "Transfer-Encoding: chunked\r\n\r\n",
+              disposition);
+}
+
+void mg_poll_export(struct mg_connection *c) {
+    export_slot_t *slot = find_slot(c);
+    if (!slot) {
+        c->data[0] = '\0';
+        return;
+    }
+    if (c->is_closing || c->is_draining) {
+        return;
+    }
+
+    export_job_t *job = slot->job;
+    pthread_mutex_lock(&job->mutex);
+    bool drained = false;
+    while (job->len > 0 && c->send.len < mg_send_limit()) {
+        size_t n = EXPORT_BUFFER_SIZE - job->head;
+        if (n > job->len) {
+            n = job->len;
+        }
+        if (n > EXPORT_CHUNK_SIZE) {
+            n = EXPORT_CHUNK_SIZE;
+        }
+        mg_http_write_chunk(c, (const char *)job->buffer + job->head, n);
+        job->head = (job->head + n) % EXPORT_BUFFER_SIZE;
+        job->len -= n;
+        drained = true;
+    }
+    if (drained) {
+        pthread_cond_signal(&job->cond);
+    }
+    bool finished = job->finished && job->len == 0;
+    bool failed = job->failed;
+    pthread_mutex_unlock(&job->mutex);
+
+    if (!finished) {
+        return;
+    }
+    if (failed) {
+        // Without the last chunk the client sees the download as broken
+        c->is_draining = 1;
+    } else {
+        mg_http_write_chunk(c, "", 0);
+    }
+    release_slot(c, slot);
+}
+
+void mg_cancel_export(struct mg_connection *c) {
+    export_slot_t *slot = find_slot(c);
+    if (slot) {
+        pthread_mutex_lock(&slot->job->mutex);
+        slot->job->cancelled = true;
+        pthread_cond_signal(&slot->job->cond);
+        pthread_mutex_unlock(&slot->job->mutex);
+    }
+    release_slot(c, slot);
+}
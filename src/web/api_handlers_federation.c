@@ -0,0 +1,1071 @@
+/**
+ * @file api_handlers_federation.c
+ * @brief API handlers answering for several lightNVR nodes at once
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <curl/curl.h>
+
+#include "web/api_handlers_federation.h"
+#include "web/api_handlers.h"
+#include "web/api_handlers_health.h"
+#include "web/api_response_compress.h"
+#include "core/logger.h"
+#include "core/config.h"
+#include "mongoose.h"
+#include "cJSON.h"
+
+// Defined in api_handlers_timeline.c
+void mg_handle_get_timeline_segments(struct mg_connection *c, struct mg_http_message *hm);
+
+// Longest query string sent to a node
+#define FEDERATION_QUERY_SIZE 2048
+
+// Longest URL of a request to a node
+#define FEDERATION_URL_SIZE (MAX_URL_LENGTH + 64 + FEDERATION_QUERY_SIZE)
+
+// Largest response accepted from a node
+#define FEDERATION_MAX_RESPONSE (16 * 1024 * 1024)
+
+// Peer responses kept for federation_cache_ttl
+#define FEDERATION_CACHE_SLOTS 64
+
+// Most items one node is asked for, the limit of /api/recordings
+#define FEDERATION_MAX_FETCH 1000
+
+typedef void (*federation_handler_t)(struct mg_connection *c, struct mg_http_message *hm);
+
+typedef struct {
+    char name[64];
+    char url[MAX_URL_LENGTH];       // Base URL, empty for this node
+} federation_node_t;
+
+// A request to one node and its answer
+typedef struct {
+    const federation_node_t *node;
+    bool asked;                     // Whether the node is part of this request
+    char query[FEDERATION_QUERY_SIZE];
+    char url[FEDERATION_URL_SIZE];  // Also the cache key
+    cJSON *json;                    // Parsed response, NULL if there is none
+    int status;                     // HTTP status, 0 if the node did not answer
+    char error[128];
+    long latency_ms;
+    bool cached;
+    char *body;
+    size_t body_len;
+} federation_reply_t;
+
+typedef struct {
+    char *url;
+    char *body;
+    uint64_t expires_ms;
+} federation_cache_entry_t;
+
+static federation_cache_entry_t s_cache[FEDERATION_CACHE_SLOTS];
+static pthread_mutex_t s_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+/**
+ * Copy of a cached response that has not expired
+ *
+ * @return Body to free, or NULL if there is none
+ */
+static char *cache_get(const char *url) {
+    char *body = NULL;
+    uint64_t now = now_ms();
+
+    pthread_mutex_lock(&s_cache_mutex);
+    for (int i = 0; i < FEDERATION_CACHE_SLOTS; i++) {
+        if (s_cache[i].url && s_cache[i].expires_ms > now && strcmp(s_cache[i].url, url) == 0) {
+            body = strdup(s_cache[i].body);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&s_cache_mutex);
+    return body;
+}
+
+/**
+ * Keep a response, in place of the same request or of the entry expiring first
+ */
+static void cache_put(const char *url, const char *body, size_t len) {
+    char *url_copy = strdup(url);
+    char *body_copy = malloc(len + 1);
+    if (!url_copy || !body_copy) {
+        free(url_copy);
+        free(body_copy);
+        return;
+    }
+    memcpy(body_copy, body, len);
+    body_copy[len] = '\0';
+
+    pthread_mutex_lock(&s_cache_mutex);
+    int slot = 0;
+    for (int i = 0; i < FEDERATION_CACHE_SLOTS; i++) {
+        if (s_cache[i].url && strcmp(s_cache[i].url, url) == 0) {
+            slot = i;
+            break;
+        }
+        if (s_cache[i].expires_ms < s_cache[slot].expires_ms) {
+            slot = i;
+        }
+    }
+    free(s_cache[slot].url);
+    free(s_cache[slot].body);
+    s_cache[slot].url = url_copy;
+    s_cache[slot].body = body_copy;
+    s_cache[slot].expires_ms = now_ms() + (uint64_t)g_config.federation_cache_ttl * 1000;
+    pthread_mutex_unlock(&s_cache_mutex);
+}
+
+/**
+ * Parse the nodes of the federation, this node first
+ *
+ * @return Number of nodes
+ */
+static int load_nodes(federation_node_t *nodes) {
+    memset(nodes, 0, sizeof(federation_node_t) * FEDERATION_MAX_NODES);
+    snprintf(nodes[0].name, sizeof(nodes[0].name), "%s", g_config.federation_node_name);
+    int count = 1;
+
+    char peers[sizeof(g_config.federation_peers)];
+    snprintf(peers, sizeof(peers), "%s", g_config.federation_peers);
+    char *saveptr = NULL;
+    for (char *entry = strtok_r(peers, ",", &saveptr); entry; entry = strtok_r(NULL, ",", &saveptr)) {
+        while (*entry == ' ') {
+            entry++;
+        }
+        char *eq = strchr(entry, '=');
+        if (!eq || eq == entry || eq[1] == '\0') {
+            log_warn("Ignoring federation peer without name=url: %s", entry);
+            continue;
+        }
+        if (count == FEDERATION_MAX_NODES) {
+            log_warn("Too many federation peers, ignoring %s", entry);
+            break;
+        }
+        *eq = '\0';
+        federation_node_t *node = &nodes[count++];
+        snprintf(node->name, sizeof(node->name), "%s", entry);
+        snprintf(node->url, sizeof(node->url), "%s", eq + 1);
+
+        // Trim the spaces around the name and the url, and a trailing /
+        for (size_t len = strlen(node->name); len > 0 && node->name[len - 1] == ' '; len--) {
+            node->name[len - 1] = '\0';
+        }
+        char *url = node->url;
+        while (*url == ' ') {
+            url++;
+        }
+        memmove(node->url, url, strlen(url) + 1);
+        for (size_t len = strlen(node->url); len > 0 && (node->url[len - 1] == ' ' || node->url[len - 1] == '/'); len--) {
+            node->url[len - 1] = '\0';
+        }
+    }
+    return count;
+}
+
+/**
+ * Whether a node is in the comma-separated nodes= filter, empty for all
+ */
+static bool node_selected(const char *filter, const char *name) {
+    if (filter[0] == '\0') {
+        return true;
+    }
+    size_t len = strlen(name);
+    for (const char *p = filter; *p; ) {
+        const char *end = strchr(p, ',');
+        size_t n = end ? (size_t)(end - p) : strlen(p);
+        if (n == len && strncmp(p, name, len) == 0) {
+            return true;
+        }
+        p += n;
+        if (*p == ',') {
+            p++;
+        }
+    }
+    return false;
+}
+
+/**
+ * Answer with 404 unless federation is enabled
+ */
+static bool federation_check(struct mg_connection *c) {
+    if (!g_config.federation_enabled) {
+        mg_send_json_error(c, 404, "Federation is not enabled");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Set up a request to each node selected by the nodes= parameter
+ *
+ * The query of each request is that of the client without the parameters
+ * in drop, which the caller sets per node.
+ */
+static void prepare_replies(struct mg_http_message *hm, const federation_node_t *nodes, int count,
+                            const char *const *drop, federation_reply_t *replies) {
+    char filter[512] = {0};
+    mg_http_get_var(&hm->query, "nodes", filter, sizeof(filter));
+
+    for (int i = 0; i < count; i++) {
+        federation_reply_t *reply = &replies[i];
+        memset(reply, 0, sizeof(*reply));
+        reply->node = &nodes[i];
+        reply->asked = node_selected(filter, nodes[i].name);
+
+        // Keep the parameters as they were encoded
+        size_t len = 0;
+        const char *p = hm->query.buf;
+        const char *end = hm->query.buf + hm->query.len;
+        while (p < end) {
+            const char *amp = memchr(p, '&', (size_t)(end - p));
+            size_t n = amp ? (size_t)(amp - p) : (size_t)(end - p);
+            const char *eq = memchr(p, '=', n);
+            size_t name_len = eq ? (size_t)(eq - p) : n;
+
+            bool keep = n > 0 && !(name_len == 5 && strncmp(p, "nodes", 5) == 0);
+            for (int d = 0; keep && drop && drop[d]; d++) {
+                if (name_len == strlen(drop[d]) && strncmp(p, drop[d], name_len) == 0) {
+                    keep = false;
+                }
+            }
+            if (keep && len + n + 2 < sizeof(reply->query)) {
+                if (len > 0) {
+                    reply->query[len++] = '&';
+                }
+                memcpy(reply->query + len, p, n);
+                len += n;
+            }
+            p += n + 1;
+        }
+        reply->query[len] = '\0';
+    }
+}
+
+/**
+ * Append a parameter to the query of a request
+ */
+static void append_param(federation_reply_t *reply, const char *name, const char *value) {
+    size_t len = strlen(reply->query);
+    char encoded[256];
+    mg_url_encode(value, strlen(value), encoded, sizeof(encoded));
+    snprintf(reply->query + len, sizeof(reply->query) - len, "%s%s=%s", len > 0 ? "&" : "", name, encoded);
+}
+
+/**
+ * Parse the body of a response, joining its chunks if it is chunked
+ */
+static cJSON *parse_response(const char *data, size_t size, int *status) {
+    *status = 0;
+    const char *head_end = memmem(data, size, "\r\n\r\n", 4);
+    if (!head_end || sscanf(data, "HTTP/1.%*d %d", status) != 1) {
+        return NULL;
+    }
+
+    size_t head_len = (size_t)(head_end - data);
+    char *headers = strndup(data, head_len);
+    if (!headers) {
+        return NULL;
+    }
+    bool chunked = strcasestr(headers, "\r\nTransfer-Encoding: chunked") != NULL;
+    free(headers);
+
+    const char *body = head_end + 4;
+    size_t body_len = size - head_len - 4;
+    unsigned char *joined = NULL;
+    if (chunked) {
+        joined = http_dechunk(body, body_len, &body_len);
+        if (!joined) {
+            return NULL;
+        }
+        body = (const char *)joined;
+    }
+
+    char *text = strndup(body, body_len);
+    free(joined);
+    if (!text) {
+        return NULL;
+    }
+    cJSON *json = cJSON_Parse(text);
+    free(text);
+    return json;
+}
+
+/**
+ * Answer a request of this node by running its handler on a connection
+ * that only collects the response, as the worker pool does
+ */
+static void call_local(struct mg_connection *c, struct mg_http_message *hm, federation_handler_t handler,
+                       federation_reply_t *reply) {
+    uint64_t started = now_ms();
+
+    struct mg_http_message local = *hm;
+    local.query = mg_str(reply->query);
+
+    struct mg_connection fake_conn = {0};
+    fake_conn.mgr = c->mgr;
+    fake_conn.id = c->id;
+    fake_conn.fn_data = c->fn_data;
+
+    handler(&fake_conn, &local);
+
+    if (fake_conn.send.buf && fake_conn.send.len > 0) {
+        reply->json = parse_response((const char *)fake_conn.send.buf, fake_conn.send.len, &reply->status);
+    }
+    free(fake_conn.send.buf);
+
+    reply->latency_ms = (long)(now_ms() - started);
+}
+
+// Collect the body of a peer's response
+static size_t write_callback(void *contents, size_t size, size_t nmemb, void *userp) {
+    size_t realsize = size * nmemb;
+    federation_reply_t *reply = (federation_reply_t *)userp;
+
+    if (reply->body_len + realsize > FEDERATION_MAX_RESPONSE) {
+        log_error("Response of federation node %s is too large", reply->node->name);
+        return 0;
+    }
+    char *ptr = realloc(reply->body, reply->body_len + realsize + 1);
+    if (!ptr) {
+        log_error("Failed to allocate memory for federation response");
+        return 0;
+    }
+
+    reply->body = ptr;
+    memcpy(reply->body + reply->body_len, contents, realsize);
+    reply->body_len += realsize;
+    reply->body[reply->body_len] = '\0';
+    return realsize;
+}
+
+static CURL *create_transfer(federation_reply_t *reply) {
+    CURL *curl = curl_easy_init();
+    if (!curl) {
+        return NULL;
+    }
+    curl_easy_setopt(curl, CURLOPT_URL, reply->url);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, reply);
+    curl_easy_setopt(curl, CURLOPT_PRIVATE, reply);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, (long)g_config.federation_timeout_ms);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, (long)g_config.federation_timeout_ms);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    // Peers compress their JSON; curl decodes it
+    curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");
+    if (g_config.federation_auth[0] != '\0') {
+        curl_easy_setopt(curl, CURLOPT_HTTPAUTH, (long)CURLAUTH_BASIC);
+        curl_easy_setopt(curl, CURLOPT_USERPWD, g_config.federation_auth);
+    }
+    return curl;
+}
+
+/**
+ * Ask every selected node at once and wait for their answers
+ *
+ * Peers are asked over HTTP, each within the peer timeout, unless their
+ * answer to the same request is cached. This node answers in-process with
+ * its own handler while the peers work.
+ */
+static void fan_out(struct mg_connection *c, struct mg_http_message *hm, const char *path,
+                    federation_handler_t local_handler, federation_reply_t *replies, int count) {
+    CURLM *multi = curl_multi_init();
+    if (!multi) {
+        log_error("Failed to initialize curl for federation request");
+    }
+
+    for (int i = 0; i < count; i++) {
+        federation_reply_t *reply = &replies[i];
+        if (!reply->asked || reply->node->url[0] == '\0') {
+            continue;
+        }
+        snprintf(reply->url, sizeof(reply->url), "%s%s%s%s", reply->node->url, path,
+                 reply->query[0] ? "?" : "", reply->query);
+
+        if (g_config.federation_cache_ttl > 0) {
+            char *body = cache_get(reply->url);
+            if (body) {
+                reply->json = cJSON_Parse(body);
+                reply->status = 200;
+                reply->cached = true;
+                free(body);
+                continue;
+            }
+        }
+
+        CURL *curl = multi ? create_transfer(reply) : NULL;
+        if (!curl) {
+            snprintf(reply->error, sizeof(reply->error), "Failed to create request");
+            continue;
+        }
+        curl_multi_add_handle(multi, curl);
+    }
+
+    int running = 0;
+    if (multi) {
+        curl_multi_perform(multi, &running);
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (replies[i].asked && replies[i].node->url[0] == '\0') {
+            call_local(c, hm, local_handler, &replies[i]);
+        }
+    }
+
+    while (running > 0) {
+        curl_multi_wait(multi, NULL, 0, 100, NULL);
+        curl_multi_perform(multi, &running);
+    }
+
+    CURLMsg *msg;
+    int left = 0;
+    while (multi && (msg = curl_multi_info_read(multi, &left))) {
+        if (msg->msg != CURLMSG_DONE) {
+            continue;
+        }
+        CURL *curl = msg->easy_handle;
+        federation_reply_t *reply = NULL;
+        curl_easy_getinfo(curl, CURLINFO_PRIVATE, (char **)&reply);
+
+        double total_time = 0;
+        curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME, &total_time);
+        reply->latency_ms = (long)(total_time * 1000);
+
+        if (msg->data.result != CURLE_OK) {
+            snprintf(reply->error, sizeof(reply->error), "%s", curl_easy_strerror(msg->data.result));
+            log_warn("Federation node %s did not answer %s: %s", reply->node->name, path, reply->error);
+        } else {
+            long status = 0;
+            curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+            reply->status = (int)status;
+            reply->json = reply->body ? cJSON_Parse(reply->body) : NULL;
+            if (status == 200 && reply->json && g_config.federation_cache_ttl > 0) {
+                cache_put(reply->url, reply->body, reply->body_len);
+            }
+        }
+
+        free(reply->body);
+        reply->body = NULL;
+        curl_multi_remove_handle(multi, curl);
+        curl_easy_cleanup(curl);
+    }
+    if (multi) {
+        curl_multi_cleanup(multi);
+    }
+
+    for (int i = 0; i < count; i++) {
+        federation_reply_t *reply = &replies[i];
+        if (!reply->asked || reply->error[0] != '\0') {
+            continue;
+        }
+        // A node without the stream or recording has nothing to add
+        if (reply->status == 404) {
+            cJSON_Delete(reply->json);
+            reply->json = NULL;
+        } else if (reply->status != 200) {
+            snprintf(reply->error, sizeof(reply->error), "HTTP %d", reply->status);
+        } else if (!reply->json) {
+            snprintf(reply->error, sizeof(reply->error), "Invalid response");
+        }
+    }
+}
+
+static void free_replies(federation_reply_t *replies, int count) {
+    for (int i = 0; i < count; i++) {
+        cJSON_Delete(replies[i].json);
+        replies[i].json = NULL;
+    }
+}
+
+/**
+ * Add how each node answered: "nodes":[{"name","ok","cached","latency_ms","error"}]
+ * and "partial" if a node is missing from the results
+ */
+static void add_node_report(cJSON *root, const federation_reply_t *replies, int count) {
+    cJSON *nodes = cJSON_AddArrayToObject(root, "nodes");
+    bool partial = false;
+    for (int i = 0; i < count; i++) {
+        const federation_reply_t *reply = &replies[i];
+        if (!reply->asked) {
+            continue;
+        }
+        cJSON *node = cJSON_CreateObject();
+        cJSON_AddStringToObject(node, "name", reply->node->name);
+        cJSON_AddBoolToObject(node, "local", reply->node->url[0] == '\0');
+        cJSON_AddBoolToObject(node, "ok", reply->error[0] == '\0');
+        cJSON_AddBoolToObject(node, "cached", reply->cached);
+        cJSON_AddNumberToObject(node, "latency_ms", (double)reply->latency_ms);
+        if (reply->error[0] != '\0') {
+            cJSON_AddStringToObject(node, "error", reply->error);
+            partial = true;
+        }
+        cJSON_AddItemToArray(nodes, node);
+    }
+    cJSON_AddBoolToObject(root, "partial", partial);
+}
+
+/**
+ * Copy an item of a node into the merged results, naming the node
+ */
+static void add_item(cJSON *array, const cJSON *item, const federation_node_t *node) {
+    cJSON *copy = cJSON_Duplicate(item, true);
+    if (!copy) {
+        return;
+    }
+    cJSON_DeleteItemFromObject(copy, "node");
+    cJSON_AddStringToObject(copy, "node", node->name);
+    cJSON_AddItemToArray(array, copy);
+}
+
+static void send_json(struct mg_connection *c, cJSON *root) {
+    char *json_str = cJSON_PrintUnformatted(root);
+    if (!json_str) {
+        mg_send_json_error(c, 500, "Failed to create response");
+        return;
+    }
+    mg_send_json_response(c, 200, json_str);
+    free(json_str);
+}
+
+// What merged items are ordered by
+typedef struct {
+    const char *key;
+    bool numeric;
+    bool descending;
+} federation_order_t;
+
+/**
+ * Compare two items in the order of the results
+ *
+ * @return < 0 if a comes first
+ */
+static int compare_items(const cJSON *a, const cJSON *b, const federation_order_t *order) {
+    const cJSON *va = cJSON_GetObjectItemCaseSensitive(a, order->key);
+    const cJSON *vb = cJSON_GetObjectItemCaseSensitive(b, order->key);
+    int cmp;
+    if (order->numeric) {
+        double da = cJSON_IsNumber(va) ? va->valuedouble : 0;
+        double db = cJSON_IsNumber(vb) ? vb->valuedouble : 0;
+        cmp = da < db ? -1 : da > db ? 1 : 0;
+    } else {
+        const char *sa = cJSON_IsString(va) ? va->valuestring : "";
+        const char *sb = cJSON_IsString(vb) ? vb->valuestring : "";
+        cmp = strcmp(sa, sb);
+    }
+    return order->descending ? -cmp : cmp;
+}
+
+// Where the previous page left a node
+typedef struct {
+    bool done;                      // Nothing more to come from the node
+    int skip;                       // Items to skip after the cursor
+    char cursor[64];                // Cursor of the node, empty for the start
+} federation_page_t;
+
+/**
+ * Parse a federated cursor: for each node "skip:cursor", or "~" once it
+ * has no more items
+ *
+ * @return 0 on success, -1 if malformed or made for other nodes
+ */
+static int parse_federated_cursor(const char *token, federation_page_t *pages, int count) {
+    const char *p = token;
+    for (int i = 0; i < count; i++) {
+        const char *end = strchr(p, ',');
+        size_t len = end ? (size_t)(end - p) : strlen(p);
+        if ((i < count - 1) != (end != NULL)) {
+            return -1;
+        }
+        if (len == 1 && *p == '~') {
+            pages[i].done = true;
+        } else {
+            char *colon = NULL;
+            long skip = strtol(p, &colon, 10);
+            if (colon == p || *colon != ':' || colon >= p + len || skip < 0 || skip > FEDERATION_MAX_FETCH) {
+                return -1;
+            }
+            size_t cursor_len = len - (size_t)(colon - p) - 1;
+            if (cursor_len >= sizeof(pages[i].cursor)) {
+                return -1;
+            }
+            pages[i].skip = (int)skip;
+            memcpy(pages[i].cursor, colon + 1, cursor_len);
+            pages[i].cursor[cursor_len] = '\0';
+        }
+        p += len + 1;
+    }
+    return 0;
+}
+
+static void format_federated_cursor(const federation_page_t *pages, int count, char *token, size_t size) {
+    size_t len = 0;
+    token[0] = '\0';
+    for (int i = 0; i < count && len < size; i++) {
+        if (pages[i].done) {
+            len += (size_t)snprintf(token + len, size - len, "%s~", i > 0 ? "," : "");
+        } else {
+            len += (size_t)snprintf(token + len, size - len, "%s%d:%s", i > 0 ? "," : "",
+                                    pages[i].skip, pages[i].cursor);
+        }
+    }
+}
+
+// A list endpoint that pages with a cursor or a limit
+typedef struct {
+    const char *path;
+    federation_handler_t local_handler;
+    const char *array;              // Member holding the items
+    const char *cursor_parent;      // Object holding next_cursor, NULL for the top level
+    int default_limit;
+    int max_limit;
+} federation_list_t;
+
+/**
+ * Merge one page of a list from all nodes
+ *
+ * Each node is asked for the items after its cursor, the skipped ones and a
+ * full page, so the page holds the first items of all nodes together in
+ * order. Nodes continue from their own cursor once all items up to it were
+ * shown, and skip those already shown otherwise.
+ *
+ * @return Merged items, with the cursor of the next page and the page size,
+ *         or NULL if an error was answered
+ */
+static cJSON *merge_pages(struct mg_connection *c, struct mg_http_message *hm, const federation_list_t *list,
+                          const federation_order_t *order, federation_reply_t *replies, int count,
+                          char *next_token, size_t next_token_size, int *page_size) {
+    federation_page_t pages[FEDERATION_MAX_NODES];
+    memset(pages, 0, sizeof(pages));
+
+    char value[1024];
+    if (mg_http_get_var(&hm->query, "cursor", value, sizeof(value)) > 0 &&
+        parse_federated_cursor(value, pages, count) != 0) {
+        mg_send_json_error(c, 400, "Invalid cursor");
+        return NULL;
+    }
+
+    int limit = list->default_limit;
+    if (mg_http_get_var(&hm->query, "limit", value, sizeof(value)) > 0) {
+        limit = atoi(value);
+    }
+    if (limit <= 0 || limit > list->max_limit) {
+        mg_send_json_error(c, 400, "Invalid limit");
+        return NULL;
+    }
+    *page_size = limit;
+
+    for (int i = 0; i < count; i++) {
+        federation_reply_t *reply = &replies[i];
+        // Nodes left out by nodes= stay out on the following pages
+        if (!reply->asked || pages[i].done) {
+            reply->asked = false;
+            pages[i].done = true;
+            continue;
+        }
+        if (pages[i].skip + limit > list->max_limit) {
+            mg_send_json_error(c, 400, "Page too deep, narrow the filters");
+            return NULL;
+        }
+        char fetch[16];
+        snprintf(fetch, sizeof(fetch), "%d", pages[i].skip + limit);
+        append_param(reply, "limit", fetch);
+        if (pages[i].cursor[0] != '\0') {
+            append_param(reply, "cursor", pages[i].cursor);
+        }
+    }
+
+    fan_out(c, hm, list->path, list->local_handler, replies, count);
+
+    // Next item of each node, walked along the arrays
+    const cJSON *heads[FEDERATION_MAX_NODES] = {0};
+    int sizes[FEDERATION_MAX_NODES] = {0};
+    int positions[FEDERATION_MAX_NODES] = {0};
+    for (int i = 0; i < count; i++) {
+        const cJSON *array = cJSON_GetObjectItemCaseSensitive(replies[i].json, list->array);
+        if (cJSON_IsArray(array)) {
+            sizes[i] = cJSON_GetArraySize(array);
+            heads[i] = cJSON_GetArrayItem(array, pages[i].skip);
+        }
+        positions[i] = pages[i].skip;
+    }
+
+    cJSON *merged = cJSON_CreateArray();
+    for (int n = 0; n < limit; n++) {
+        int best = -1;
+        for (int i = 0; i < count; i++) {
+            if (heads[i] && (best < 0 || compare_items(heads[i], heads[best], order) < 0)) {
+                best = i;
+            }
+        }
+        if (best < 0) {
+            break;
+        }
+        add_item(merged, heads[best], replies[best].node);
+        heads[best] = heads[best]->next;
+        positions[best]++;
+    }
+
+    // Where each node continues; nodes that did not answer are asked again
+    // from where they were, and those without the data are done
+    bool more = false;
+    for (int i = 0; i < count; i++) {
+        federation_reply_t *reply = &replies[i];
+        if (pages[i].done) {
+            continue;
+        }
+        if (!reply->json) {
+            pages[i].done = reply->error[0] == '\0';
+            more |= !pages[i].done;
+            continue;
+        }
+        const cJSON *parent = list->cursor_parent ?
+            cJSON_GetObjectItemCaseSensitive(reply->json, list->cursor_parent) : reply->json;
+        const cJSON *next = cJSON_GetObjectItemCaseSensitive(parent, "next_cursor");
+        int fetched = pages[i].skip + limit;
+
+        if (positions[i] < sizes[i]) {
+            pages[i].skip = positions[i];
+        } else if (cJSON_IsString(next) && strlen(next->valuestring) < sizeof(pages[i].cursor)) {
+            snprintf(pages[i].cursor, sizeof(pages[i].cursor), "%s", next->valuestring);
+            pages[i].skip = 0;
+        } else if (sizes[i] < fetched) {
+            pages[i].done = true;
+        } else {
+            pages[i].skip = positions[i];
+        }
+        more |= !pages[i].done;
+    }
+
+    next_token[0] = '\0';
+    if (more) {
+        format_federated_cursor(pages, count, next_token, next_token_size);
+    }
+    return merged;
+}
+
+/**
+ * @brief Handler for GET /api/federation/nodes
+ */
+void mg_handle_get_federation_nodes(struct mg_connection *c, struct mg_http_message *hm) {
+    if (!federation_check(c)) {
+        return;
+    }
+
+    federation_node_t nodes[FEDERATION_MAX_NODES];
+    federation_reply_t replies[FEDERATION_MAX_NODES];
+    int count = load_nodes(nodes);
+    prepare_replies(hm, nodes, count, NULL, replies);
+    for (int i = 0; i < count; i++) {
+        replies[i].query[0] = '\0';
+    }
+    fan_out(c, hm, "/api/health", mg_handle_get_health, replies, count);
+
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddStringToObject(root, "node", g_config.federation_node_name);
+    add_node_report(root, replies, count);
+
+    // Add the address and health of each node to the report
+    cJSON *report = cJSON_GetObjectItemCaseSensitive(root, "nodes");
+    int r = 0;
+    for (int i = 0; i < count; i++) {
+        if (!replies[i].asked) {
+            continue;
+        }
+        cJSON *node = cJSON_GetArrayItem(report, r++);
+        cJSON_AddStringToObject(node, "url", nodes[i].url);
+        if (replies[i].json) {
+            cJSON_AddItemToObject(node, "health", cJSON_Duplicate(replies[i].json, true));
+        }
+    }
+
+    send_json(c, root);
+    cJSON_Delete(root);
+    free_replies(replies, count);
+}
+
+/**
+ * @brief Handler for GET /api/federation/streams
+ */
+void mg_handle_get_federation_streams(struct mg_connection *c, struct mg_http_message *hm) {
+    if (!federation_check(c)) {
+        return;
+    }
+
+    federation_node_t nodes[FEDERATION_MAX_NODES];
+    federation_reply_t replies[FEDERATION_MAX_NODES];
+    int count = load_nodes(nodes);
+    prepare_replies(hm, nodes, count, NULL, replies);
+    fan_out(c, hm, "/api/streams", mg_handle_get_streams, replies, count);
+
+    cJSON *root = cJSON_CreateObject();
+    cJSON *streams = cJSON_AddArrayToObject(root, "streams");
+    for (int i = 0; i < count; i++) {
+        const cJSON *item;
+        cJSON_ArrayForEach(item, cJSON_IsArray(replies[i].json) ? replies[i].json : NULL) {
+            add_item(streams, item, &nodes[i]);
+        }
+    }
+    add_node_report(root, replies, count);
+
+    send_json(c, root);
+    cJSON_Delete(root);
+    free_replies(replies, count);
+}
+
+/**
+ * @brief Handler for GET /api/federation/recordings
+ */
+void mg_handle_get_federation_recordings(struct mg_connection *c, struct mg_http_message *hm) {
+    if (!federation_check(c)) {
+        return;
+    }
+
+    // Sorts the merge can follow; size is formatted for display
+    char sort[32] = "start_time";
+    char sort_order[8] = "desc";
+    mg_http_get_var(&hm->query, "sort", sort, sizeof(sort));
+    mg_http_get_var(&hm->query, "order", sort_order, sizeof(sort_order));
+    federation_order_t order = {sort, false, strcmp(sort_order, "asc") != 0};
+    if (strcmp(sort, "id") == 0) {
+        order.numeric = true;
+    } else if (strcmp(sort, "stream_name") == 0) {
+        order.key = "stream";
+    } else if (strcmp(sort, "start_time") != 0 && strcmp(sort, "end_time") != 0) {
+        mg_send_json_error(c, 400, "Unsupported sort for federated recordings");
+        return;
+    }
+
+    static const char *const drop[] = {"cursor", "limit", "page", NULL};
+    static const federation_list_t list = {
+        "/api/recordings", mg_handle_get_recordings, "recordings", "pagination", 20, FEDERATION_MAX_FETCH
+    };
+
+    federation_node_t nodes[FEDERATION_MAX_NODES];
+    federation_reply_t replies[FEDERATION_MAX_NODES];
+    int count = load_nodes(nodes);
+    prepare_replies(hm, nodes, count, drop, replies);
+
+    char next_cursor[FEDERATION_MAX_NODES * 80];
+    int limit = 0;
+    cJSON *recordings = merge_pages(c, hm, &list, &order, replies, count, next_cursor, sizeof(next_cursor), &limit);
+    if (!recordings) {
+        free_replies(replies, count);
+        return;
+    }
+
+    // The total is known if every node counted its recordings
+    double total = 0;
+    bool counted = true;
+    for (int i = 0; i < count; i++) {
+        if (!replies[i].asked) {
+            continue;
+        }
+        const cJSON *pagination = cJSON_GetObjectItemCaseSensitive(replies[i].json, "pagination");
+        const cJSON *node_total = cJSON_GetObjectItemCaseSensitive(pagination, "total");
+        if (cJSON_IsNumber(node_total)) {
+            total += node_total->valuedouble;
+        } else {
+            counted = false;
+        }
+    }
+
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddItemToObject(root, "recordings", recordings);
+    cJSON *pagination = cJSON_AddObjectToObject(root, "pagination");
+    cJSON_AddNumberToObject(pagination, "limit", limit);
+    if (counted) {
+        cJSON_AddNumberToObject(pagination, "total", total);
+    } else {
+        cJSON_AddNullToObject(pagination, "total");
+    }
+    if (next_cursor[0] != '\0') {
+        cJSON_AddStringToObject(pagination, "next_cursor", next_cursor);
+    } else {
+        cJSON_AddNullToObject(pagination, "next_cursor");
+    }
+    add_node_report(root, replies, count);
+
+    send_json(c, root);
+    cJSON_Delete(root);
+    free_replies(replies, count);
+}
+
+/**
+ * @brief Handler for GET /api/federation/detection/search
+ */
+void mg_handle_get_federation_detection_search(struct mg_connection *c, struct mg_http_message *hm) {
+    if (!federation_check(c)) {
+        return;
+    }
+
+    char label[64] = {0};
+    if (mg_http_get_var(&hm->query, "label", label, sizeof(label)) <= 0) {
+        mg_send_json_error(c, 400, "Missing label");
+        return;
+    }
+
+    static const char *const drop[] = {"cursor", "limit", NULL};
+    static const federation_list_t list = {
+        "/api/detection/search", mg_handle_get_detection_search, "results", NULL, 50, 500
+    };
+    const federation_order_t order = {"timestamp", true, true};
+
+    federation_node_t nodes[FEDERATION_MAX_NODES];
+    federation_reply_t replies[FEDERATION_MAX_NODES];
+    int count = load_nodes(nodes);
+    prepare_replies(hm, nodes, count, drop, replies);
+
+    char next_cursor[FEDERATION_MAX_NODES * 80];
+    int limit = 0;
+    cJSON *results = merge_pages(c, hm, &list, &order, replies, count, next_cursor, sizeof(next_cursor), &limit);
+    if (!results) {
+        free_replies(replies, count);
+        return;
+    }
+
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddStringToObject(root, "label", label);
+    cJSON_AddItemToObject(root, "results", results);
+    if (next_cursor[0] != '\0') {
+        cJSON_AddStringToObject(root, "next_cursor", next_cursor);
+    } else {
+        cJSON_AddNullToObject(root, "next_cursor");
+    }
+    add_node_report(root, replies, count);
+
+    send_json(c, root);
+    cJSON_Delete(root);
+    free_replies(replies, count);
+}
+
+static const federation_order_t s_segment_order = {"start_timestamp", true, false};
+
+static int compare_segments(const void *a, const void *b) {
+    return compare_items(*(const cJSON *const *)a, *(const cJSON *const *)b, &s_segment_order);
+}
+
+/**
+ * @brief Handler for GET /api/federation/timeline/segments
+ */
+void mg_handle_get_federation_timeline_segments(struct mg_connection *c, struct mg_http_message *hm) {
+    if (!federation_check(c)) {
+        return;
+    }
+
+    char stream[MAX_STREAM_NAME] = {0};
+    if (mg_http_get_var(&hm->query, "stream", stream, sizeof(stream)) <= 0) {
+        mg_send_json_error(c, 400, "Missing stream parameter");
+        return;
+    }
+
+    federation_node_t nodes[FEDERATION_MAX_NODES];
+    federation_reply_t replies[FEDERATION_MAX_NODES];
+    int count = load_nodes(nodes);
+    prepare_replies(hm, nodes, count, NULL, replies);
+    fan_out(c, hm, "/api/timeline/segments", mg_handle_get_timeline_segments, replies, count);
+
+    // Segments of all nodes, in time order
+    int total = 0;
+    for (int i = 0; i < count; i++) {
+        total += cJSON_GetArraySize(cJSON_GetObjectItemCaseSensitive(replies[i].json, "segments"));
+    }
+    cJSON **segments = calloc(total > 0 ? (size_t)total : 1, sizeof(cJSON *));
+    if (!segments) {
+        free_replies(replies, count);
+        mg_send_json_error(c, 500, "Failed to allocate memory");
+        return;
+    }
+
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddStringToObject(root, "stream", stream);
+    cJSON *merged = cJSON_AddArrayToObject(root, "segments");
+
+    int n = 0;
+    for (int i = 0; i < count; i++) {
+        cJSON *item;
+        cJSON_ArrayForEach(item, cJSON_GetObjectItemCaseSensitive(replies[i].json, "segments")) {
+            // Name the node before sorting, so each segment keeps it
+            cJSON_DeleteItemFromObject(item, "node");
+            cJSON_AddStringToObject(item, "node", nodes[i].name);
+            segments[n++] = item;
+        }
+    }
+    qsort(segments, (size_t)n, sizeof(cJSON *), compare_segments);
+    for (int k = 0; k < n; k++) {
+        cJSON_AddItemToArray(merged, cJSON_Duplicate(segments[k], true));
+    }
+    free(segments);
+
+    add_node_report(root, replies, count);
+    send_json(c, root);
+    cJSON_Delete(root);
+    free_replies(replies, count);
+}
+
+/**
+ * @brief Handler for /api/federation/node/{node}/{path}
+ */
+void mg_handle_federation_node_redirect(struct mg_connection *c, struct mg_http_message *hm) {
+    if (!federation_check(c)) {
+        return;
+    }
+
+    static const char prefix[] = "/api/federation/node/";
+    size_t prefix_len = sizeof(prefix) - 1;
+    if (hm->uri.len <= prefix_len) {
+        mg_send_json_error(c, 400, "Missing node");
+        return;
+    }
+    const char *name = hm->uri.buf + prefix_len;
+    const char *uri_end = hm->uri.buf + hm->uri.len;
+    const char *slash = memchr(name, '/', (size_t)(uri_end - name));
+    if (!slash) {
+        mg_send_json_error(c, 400, "Missing path");
+        return;
+    }
+
+    char decoded[64];
+    if (mg_url_decode(name, (size_t)(slash - name), decoded, sizeof(decoded), 0) <= 0) {
+        mg_send_json_error(c, 400, "Invalid node");
+        return;
+    }
+
+    federation_node_t nodes[FEDERATION_MAX_NODES];
+    int count = load_nodes(nodes);
+    const federation_node_t *node = NULL;
+    for (int i = 0; i < count; i++) {
+        if (strcmp(nodes[i].name, decoded) == 0) {
+            node = &nodes[i];
+            break;
+        }
+    }
+    if (!node) {
+        mg_send_json_error(c, 404, "Node not found");
+        return;
+    }
+
+    // 307 keeps the method and body, for WebRTC offers
+    char location[FEDERATION_URL_SIZE];
+    snprintf(location, sizeof(location), "%s%.*s%s%.*s", node->url, (int)(uri_end - slash), slash,
+             hm->query.len > 0 ? "?" : "", (int)hm->query.len, hm->query.buf);
+    mg_printf(c, "HTTP/1.1 307 Temporary Redirect\r\n"
+                 "Location: %s\r\n"
+                 "Cache-Control: no-store\r\n"
+                 "Content-Length: 0\r\n\r\n", location);
+}
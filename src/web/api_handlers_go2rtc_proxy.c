@@ -18,6 +18,7 @@
 #include "mongoose.h"
 #include "video/go2rtc/go2rtc_integration.h"
 #include "video/go2rtc/go2rtc_stream.h"
+#include "video/go2rtc/go2rtc_api.h"
 #include "web/mongoose_server_multithreading.h"
 #include "web/api_handlers_go2rtc_proxy.h"
 
@@ -163,8 +164,8 @@ void mg_handle_go2rtc_webrtc_offer_worker(struct mg_connection *c, struct mg_htt
     strncpy(offer_preview, offer, 100);
     log_info("WebRTC offer preview: %s", offer_preview);
     
-    // Proxy the request to go2rtc API
-    curl = curl_easy_init();
+    // Proxy the request to go2rtc API on this thread's keep-alive connection
+    curl = go2rtc_api_get_curl();
     if (!curl) {
         log_error("Failed to initialize curl");
         mg_send_json_error(c, 500, "Failed to initialize curl");
@@ -289,9 +290,6 @@ cleanup:
     if (headers) {
         curl_slist_free_all(headers);
     }
-    if (curl) {
-        curl_easy_cleanup(curl);
-    }
     if (response.data) {
         free(response.data);
     }
@@ -434,8 +432,8 @@ void mg_handle_go2rtc_webrtc_ice_worker(struct mg_connection *c, struct mg_http_
     strncpy(ice_preview, ice_candidate, 100);
     log_info("ICE candidate preview: %s", ice_preview);
     
-    // Proxy the request to go2rtc API
-    curl = curl_easy_init();
+    // Proxy the request to go2rtc API on this thread's keep-alive connection
+    curl = go2rtc_api_get_curl();
     if (!curl) {
         log_error("Failed to initialize curl");
         mg_send_json_error(c, 500, "Failed to initialize curl");
@@ -553,9 +551,6 @@ cleanup:
     if (headers) {
         curl_slist_free_all(headers);
     }
-    if (curl) {
-        curl_easy_cleanup(curl);
-    }
     if (response.data) {
         free(response.data);
     }
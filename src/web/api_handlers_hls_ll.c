@@ -0,0 +1,270 @@
+// Low-Latency HLS: playlists, parts and blocking requests
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "web/mongoose_adapter.h"
+#include "core/logger.h"
+#include "core/config.h"
+#include "web/api_handlers.h"
+#include "web/api_response_compress.h"
+#include "video/hls/hls_ll_packager.h"
+#include "mongoose.h"
+
+// Marks connections holding a blocking LL-HLS request in c->data[0]
+#define LL_HLS_PENDING_MARK 'L'
+
+// Most requests held at the same time; further ones are answered right away
+#define LL_HLS_MAX_PENDING 64
+
+/**
+ * Blocking request held until its part is published
+ * Only used from the event loop thread that owns the connection. Each loop
+ * has its own table, since connection IDs are only unique within a loop.
+ */
+typedef struct {
+    bool used;
+    unsigned long conn_id;
+    char stream_name[MAX_STREAM_NAME];
+    bool is_playlist;
+    int64_t msn;                // Playlist: _HLS_msn
+    int part;                   // Playlist: _HLS_part, or -1 for the whole segment
+    int64_t part_sequence;      // Preload hint: number of the part
+    char file_name[64];
+    bool is_head;
+    api_encoding_t encoding;    // Playlist: coding the client accepts
+    uint64_t deadline;          // mg_millis() after which the request is answered anyway
+} ll_pending_request_t;
+
+static _Thread_local ll_pending_request_t pending_requests[LL_HLS_MAX_PENDING];
+
+static const char *ll_cors_headers =
+    "Access-Control-Allow-Origin: *\r\n"
+    "Access-Control-Allow-Methods: GET, OPTIONS\r\n"
+    "Access-Control-Allow-Headers: Origin, Content-Type, Accept, Authorization\r\n";
+
+/**
+ * Send a response body with its content type and close the connection afterwards
+ */
+static void send_data(struct mg_connection *c, const char *content_type, const void *data, size_t size,
+                      bool is_head) {
+    mg_printf(c,
+              "HTTP/1.1 200 OK\r\n"
+              "Content-Type: %s\r\n"
+              "Cache-Control: no-cache, no-store, must-revalidate\r\n"
+              "Connection: close\r\n"
+              "%s"
+              "Content-Length: %lu\r\n\r\n",
+              content_type, ll_cors_headers, (unsigned long)size);
+    if (!is_head) {
+        mg_send(c, data, size);
+    }
+    c->is_draining = 1;
+}
+
+/**
+ * Send the current playlist of a stream
+ */
+static void send_playlist(struct mg_connection *c, const char *stream_name, bool is_head,
+                          api_encoding_t encoding) {
+    size_t length = 0;
+    char *playlist = hls_ll_build_playlist(stream_name, &length);
+    if (!playlist) {
+        mg_http_reply(c, 404, "", "{\"error\": \"HLS file not found or still being generated by FFmpeg\"}\n");
+        return;
+    }
+
+    // Held requests are answered outside the request handler, so they are
+    // compressed here
+    size_t start = c->send.len;
+    send_data(c, "application/vnd.apple.mpegurl", playlist, length, is_head);
+    api_compress_response(c, encoding, start);
+    free(playlist);
+}
+
+/**
+ * Send the initialization section, a part or a segment of a stream
+ */
+static void send_resource(struct mg_connection *c, const char *stream_name, const char *file_name, bool is_head) {
+    AVBufferRef *data = NULL;
+    if (hls_ll_get_resource(stream_name, file_name, &data) != 0) {
+        log_debug("LL-HLS resource not available: %s/%s", stream_name, file_name);
+        mg_http_reply(c, 404, "", "{\"error\": \"HLS file not found or still being generated by FFmpeg\"}\n");
+        return;
+    }
+
+    const char *content_type = strcmp(file_name, HLS_LL_INIT_NAME) == 0 ? "video/mp4" : "video/iso.segment";
+    send_data(c, content_type, data->data, data->size, is_head);
+    av_buffer_unref(&data);
+}
+
+/**
+ * Check whether the part a held request waits for is available
+ *
+ * @return 1 if available, 0 if not yet, -1 if it never will be
+ */
+static int pending_ready(const ll_pending_request_t *request) {
+    if (request->is_playlist) {
+        return hls_ll_playlist_ready(request->stream_name, request->msn, request->part);
+    }
+    return hls_ll_part_ready(request->stream_name, request->part_sequence);
+}
+
+/**
+ * Answer a held or ready request
+ */
+static void respond(struct mg_connection *c, const ll_pending_request_t *request) {
+    if (request->is_playlist) {
+        send_playlist(c, request->stream_name, request->is_head, request->encoding);
+    } else {
+        send_resource(c, request->stream_name, request->file_name, request->is_head);
+    }
+}
+
+/**
+ * Answer a request now if its part is available, otherwise hold it
+ */
+static void respond_or_hold(struct mg_connection *c, const ll_pending_request_t *request) {
+    if (pending_ready(request) != 0) {
+        respond(c, request);
+        return;
+    }
+
+    for (int i = 0; i < LL_HLS_MAX_PENDING; i++) {
+        if (!pending_requests[i].used) {
+            pending_requests[i] = *request;
+            pending_requests[i].used = true;
+            pending_requests[i].conn_id = c->id;
+            pending_requests[i].deadline = mg_millis() + (uint64_t)hls_ll_block_timeout_ms(request->stream_name);
+            c->data[0] = LL_HLS_PENDING_MARK;
+            return;
+        }
+    }
+
+    // Too many held requests; the player retries with the playlist it gets now
+    log_warn("Too many blocking LL-HLS requests, answering %s/%s immediately",
+            request->stream_name, request->file_name);
+    respond(c, request);
+}
+
+/**
+ * Find the held request of a connection
+ */
+static ll_pending_request_t *find_pending(const struct mg_connection *c) {
+    for (int i = 0; i < LL_HLS_MAX_PENDING; i++) {
+        if (pending_requests[i].used && pending_requests[i].conn_id == c->id) {
+            return &pending_requests[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Parse a numeric query parameter
+ *
+ * @return true if present and valid
+ */
+static bool get_query_number(struct mg_http_message *hm, const char *name, long long *value) {
+    char buf[32] = {0};
+    if (mg_http_get_var(&hm->query, name, buf, sizeof(buf)) <= 0) {
+        return false;
+    }
+
+    char *end = NULL;
+    *value = strtoll(buf, &end, 10);
+    return end != buf && *end == '\0' && *value >= 0;
+}
+
+bool mg_handle_ll_hls_request(struct mg_connection *c, struct mg_http_message *hm,
+                              const char *stream_name, const char *file_name) {
+    if (!hls_ll_is_active(stream_name)) {
+        return false;
+    }
+
+    ll_pending_request_t request = {0};
+    strncpy(request.stream_name, stream_name, MAX_STREAM_NAME - 1);
+    strncpy(request.file_name, file_name, sizeof(request.file_name) - 1);
+    request.is_head = mg_strcmp(hm->method, mg_str("HEAD")) == 0;
+    request.encoding = api_response_encoding(hm);
+    request.part = -1;
+
+    if (strcmp(file_name, "index.m3u8") == 0) {
+        request.is_playlist = true;
+
+        long long msn = 0;
+        long long part = -1;
+        bool has_msn = get_query_number(hm, "_HLS_msn", &msn);
+        bool has_part = get_query_number(hm, "_HLS_part", &part);
+
+        if (has_part && !has_msn) {
+            mg_http_reply(c, 400, "", "{\"error\": \"_HLS_part requires _HLS_msn\"}\n");
+            return true;
+        }
+
+        if (has_msn) {
+            request.msn = msn;
+            request.part = has_part ? (int)part : -1;
+            if (hls_ll_playlist_ready(stream_name, request.msn, request.part) < 0) {
+                mg_http_reply(c, 400, "", "{\"error\": \"Requested segment is too far ahead\"}\n");
+                return true;
+            }
+        } else {
+            // Without a blocking request, wait only until the first segment is complete
+            request.msn = 0;
+        }
+
+        respond_or_hold(c, &request);
+        return true;
+    }
+
+    if (strcmp(file_name, HLS_LL_INIT_NAME) == 0) {
+        send_resource(c, stream_name, file_name, request.is_head);
+        return true;
+    }
+
+    long long sequence = 0;
+    char suffix[8] = {0};
+    if (sscanf(file_name, "ll_part_%lld.%7s", &sequence, suffix) == 2 && strcmp(suffix, "m4s") == 0) {
+        // The preload hint names the next part before it is published
+        request.part_sequence = sequence;
+        if (hls_ll_part_ready(stream_name, sequence) == 0) {
+            respond_or_hold(c, &request);
+        } else {
+            send_resource(c, stream_name, file_name, request.is_head);
+        }
+        return true;
+    }
+
+    if (strncmp(file_name, "ll_segment_", 11) == 0) {
+        send_resource(c, stream_name, file_name, request.is_head);
+        return true;
+    }
+
+    // Regular HLS files of the same stream
+    return false;
+}
+
+void mg_poll_ll_hls_request(struct mg_connection *c) {
+    ll_pending_request_t *request = find_pending(c);
+    if (!request) {
+        c->data[0] = '\0';
+        return;
+    }
+
+    // Inactive streams and timeouts get whatever is available now
+    if (pending_ready(request) == 0 && mg_millis() < request->deadline) {
+        return;
+    }
+
+    respond(c, request);
+    request->used = false;
+    c->data[0] = '\0';
+}
+
+void mg_cancel_ll_hls_request(struct mg_connection *c) {
+    ll_pending_request_t *request = find_pending(c);
+    if (request) {
+        request->used = false;
+    }
+    c->data[0] = '\0';
+}
@@ -0,0 +1,169 @@
+#include <stdlib.h>
+
+#include "web/api_handlers_metrics.h"
+#include "web/api_handlers.h"
+#include "web/mongoose_server_multithreading.h"
+#include "core/metrics.h"
+#include "core/pipeline_trace.h"
+#include "core/profiler.h"
+#include "core/logger.h"
+#include "mongoose.h"
+#include "cJSON.h"
+
+// Capture window used when the request does not set one
+#define DEFAULT_TRACE_SECONDS 10
+
+// Profile length used when the request does not set one
+#define DEFAULT_PROFILE_SECONDS 30
+
+/**
+ * @brief Direct handler for GET /metrics
+ */
+void mg_handle_get_metrics(struct mg_connection *c, struct mg_http_message *hm) {
+    (void)hm;
+
+    size_t len = 0;
+    char *text = metrics_format(&len);
+    if (!text) {
+        log_error("Failed to format metrics");
+        mg_http_reply(c, 500, "Content-Type: text/plain\r\n", "Failed to format metrics\n");
+        return;
+    }
+
+    mg_printf(c, "HTTP/1.1 200 OK\r\n"
+                 "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                 "Cache-Control: no-cache\r\n"
+                 "Content-Length: %zu\r\n\r\n", len);
+    mg_send(c, text, len);
+    free(text);
+}
+
+/**
+ * @brief Direct handler for POST /api/system/trace
+ */
+void mg_handle_post_pipeline_trace(struct mg_connection *c, struct mg_http_message *hm) {
+    int seconds = DEFAULT_TRACE_SECONDS;
+    int every = 1;
+
+    if (hm->body.len > 0) {
+        cJSON *json = mg_parse_json_body(hm);
+        if (!json) {
+            mg_send_json_error(c, 400, "Invalid JSON in request body");
+            return;
+        }
+        cJSON *seconds_json = cJSON_GetObjectItem(json, "seconds");
+        if (cJSON_IsNumber(seconds_json)) {
+            seconds = seconds_json->valueint;
+        }
+        cJSON *every_json = cJSON_GetObjectItem(json, "every");
+        if (cJSON_IsNumber(every_json)) {
+            every = every_json->valueint;
+        }
+        cJSON_Delete(json);
+    }
+
+    if (seconds <= 0 || seconds > PIPELINE_TRACE_MAX_WINDOW || every <= 0) {
+        mg_send_json_error(c, 400, "seconds must be between 1 and 60 and every at least 1");
+        return;
+    }
+
+    if (pipeline_trace_capture_start(seconds, every) != 0) {
+        mg_send_json_error(c, 500, "Failed to start the trace capture");
+        return;
+    }
+
+    cJSON *response = cJSON_CreateObject();
+    if (!response) {
+        mg_send_json_error(c, 500, "Failed to create response JSON");
+        return;
+    }
+    cJSON_AddBoolToObject(response, "capturing", true);
+    cJSON_AddNumberToObject(response, "seconds", seconds);
+    cJSON_AddNumberToObject(response, "every", every);
+
+    char *json_str = cJSON_PrintUnformatted(response);
+    cJSON_Delete(response);
+    if (!json_str) {
+        mg_send_json_error(c, 500, "Failed to convert response JSON to string");
+        return;
+    }
+    mg_send_json_response(c, 200, json_str);
+    free(json_str);
+}
+
+/**
+ * @brief Direct handler for GET /api/system/trace
+ */
+void mg_handle_get_pipeline_trace(struct mg_connection *c, struct mg_http_message *hm) {
+    (void)hm;
+
+    size_t len = 0;
+    char *text = pipeline_trace_format_events(&len);
+    if (!text) {
+        log_error("Failed to format pipeline trace events");
+        mg_send_json_error(c, 500, "Failed to format trace events");
+        return;
+    }
+
+    mg_printf(c, "HTTP/1.1 200 OK\r\n"
+                 "Content-Type: application/json\r\n"
+                 "Cache-Control: no-cache\r\n"
+                 "Content-Disposition: attachment; filename=\"lightnvr-trace.json\"\r\n"
+                 "Content-Length: %zu\r\n\r\n", len);
+    mg_send(c, text, len);
+    free(text);
+}
+
+/**
+ * @brief Profile on a worker thread, which is blocked for the whole profile
+ */
+static void profile_worker(struct mg_connection *c, struct mg_http_message *hm) {
+    if (!profiler_available()) {
+        mg_send_json_error(c, 501, "Profiler not built in, configure with -DENABLE_PROFILER=ON");
+        return;
+    }
+
+    int seconds = DEFAULT_PROFILE_SECONDS;
+    int hz = PROFILER_DEFAULT_HZ;
+    char param[16];
+    if (mg_http_get_var(&hm->query, "seconds", param, sizeof(param)) > 0) {
+        seconds = atoi(param);
+    }
+    if (mg_http_get_var(&hm->query, "hz", param, sizeof(param)) > 0) {
+        hz = atoi(param);
+    }
+    if (seconds <= 0 || seconds > PROFILER_MAX_SECONDS || hz <= 0 || hz > PROFILER_MAX_HZ) {
+        mg_send_json_error(c, 400, "seconds must be between 1 and 300 and hz between 1 and 1000");
+        return;
+    }
+
+    profile_result_t result;
+    int ret = profiler_run(seconds, hz, &result);
+    if (ret == PROFILER_ERR_BUSY) {
+        mg_send_json_error(c, 409, "A profile is already running");
+        return;
+    }
+    if (ret != 0) {
+        mg_send_json_error(c, 500, "Failed to profile");
+        return;
+    }
+
+    mg_printf(c, "HTTP/1.1 200 OK\r\n"
+                 "Content-Type: text/plain; charset=utf-8\r\n"
+                 "Cache-Control: no-cache\r\n"
+                 "X-Profile-Samples: %d\r\n"
+                 "X-Profile-Dropped: %d\r\n"
+                 "Content-Length: %zu\r\n\r\n", result.samples, result.dropped, result.len);
+    mg_send(c, result.folded, result.len);
+    free(result.folded);
+}
+
+/**
+ * @brief Direct handler for GET /api/system/profile
+ */
+void mg_handle_get_profile(struct mg_connection *c, struct mg_http_message *hm) {
+    // Always on a worker, so the event loop keeps running even without auto-threading
+    if (!mg_offload_request(c, hm, profile_worker)) {
+        return;
+    }
+}
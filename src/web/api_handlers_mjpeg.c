@@ -0,0 +1,155 @@
+/**
+ * @file api_handlers_mjpeg.c
+ * @brief Live MJPEG stream endpoint
+ *
+ * Each connection is a viewer of its stream's broadcast. The event loop
+ * checks for a new frame on every poll and queues it as the next part of
+ * the multipart response. A connection that has not finished sending its
+ * previous frame skips the new one, so a slow client falls behind by whole
+ * frames instead of queueing them up.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include <libavutil/buffer.h>
+
+#include "web/api_handlers_mjpeg.h"
+#include "web/api_handlers.h"
+#include "core/config.h"
+#include "core/logger.h"
+#include "core/metrics.h"
+#include "video/streams.h"
+#include "video/mjpeg_broadcast.h"
+#include "mongoose.h"
+
+#define MJPEG_SUFFIX "/mjpeg"
+#define MJPEG_BOUNDARY "lightnvrframe"
+
+// Live MJPEG viewer, only used from the event loop thread that owns it
+typedef struct {
+    bool used;
+    unsigned long conn_id;
+    int channel;
+    uint64_t seq;               // Last frame sent or skipped
+} mjpeg_slot_t;
+
+static _Thread_local mjpeg_slot_t mjpeg_slots[MAX_MJPEG_CLIENTS];
+
+static pthread_once_t metrics_once = PTHREAD_ONCE_INIT;
+static metric_t sent_metric;
+static metric_t dropped_metric;
+
+static void register_metrics(void) {
+    sent_metric = metrics_counter("lightnvr_mjpeg_frames_total",
+                                  "Live MJPEG frames encoded, sent and dropped", "result", "sent", NULL);
+    dropped_metric = metrics_counter("lightnvr_mjpeg_frames_total",
+                                     "Live MJPEG frames encoded, sent and dropped", "result", "dropped", NULL);
+}
+
+static mjpeg_slot_t *find_slot(const struct mg_connection *c) {
+    for (int i = 0; i < MAX_MJPEG_CLIENTS; i++) {
+        if (mjpeg_slots[i].used && mjpeg_slots[i].conn_id == c->id) {
+            return &mjpeg_slots[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Handler for GET /api/streams/:name/mjpeg
+ */
+void mg_handle_get_stream_mjpeg(struct mg_connection *c, struct mg_http_message *hm) {
+    pthread_once(&metrics_once, register_metrics);
+
+    // Extract the stream name between the prefix and the suffix
+    char stream_id[MAX_STREAM_NAME * 3];
+    if (mg_extract_path_param(hm, "/api/streams/", stream_id, sizeof(stream_id)) != 0) {
+        mg_send_json_error(c, 400, "Invalid request path");
+        return;
+    }
+    size_t id_len = strlen(stream_id);
+    size_t suffix_len = strlen(MJPEG_SUFFIX);
+    if (id_len <= suffix_len || strcmp(stream_id + id_len - suffix_len, MJPEG_SUFFIX) != 0) {
+        mg_send_json_error(c, 400, "Invalid request path");
+        return;
+    }
+    stream_id[id_len - suffix_len] = '\0';
+
+    char decoded_id[MAX_STREAM_NAME];
+    mg_url_decode(stream_id, strlen(stream_id), decoded_id, sizeof(decoded_id), 0);
+
+    if (!get_stream_by_name(decoded_id)) {
+        mg_send_json_error(c, 404, "Stream not found");
+        return;
+    }
+
+    mjpeg_slot_t *slot = NULL;
+    for (int i = 0; i < MAX_MJPEG_CLIENTS && !slot; i++) {
+        if (!mjpeg_slots[i].used) {
+            slot = &mjpeg_slots[i];
+        }
+    }
+    int channel = slot ? mjpeg_broadcast_join(decoded_id) : -1;
+    if (channel < 0) {
+        mg_http_reply(c, 503, "Content-Type: application/json\r\nRetry-After: 10\r\n",
+                      "{\"error\": \"Live MJPEG unavailable or at its client limit\"}\n");
+        return;
+    }
+
+    slot->used = true;
+    slot->conn_id = c->id;
+    slot->channel = channel;
+    slot->seq = 0;
+    c->data[0] = MG_MJPEG_MARK;
+
+    log_debug("Live MJPEG of %s to connection %lu", decoded_id, c->id);
+    mg_printf(c, "HTTP/1.1 200 OK\r\n"
+                 "Content-Type: multipart/x-mixed-replace; boundary=" MJPEG_BOUNDARY "\r\n"
+                 "Cache-Control: no-cache, no-store\r\n"
+                 "Pragma: no-cache\r\n"
+                 "Connection: close\r\n\r\n");
+}
+
+void mg_poll_mjpeg(struct mg_connection *c) {
+    mjpeg_slot_t *slot = find_slot(c);
+    if (!slot) {
+        c->data[0] = '\0';
+        return;
+    }
+    if (c->is_closing || c->is_draining) {
+        return;
+    }
+
+    AVBufferRef *jpeg = NULL;
+    slot->seq = mjpeg_broadcast_frame(slot->channel, slot->seq, &jpeg);
+    if (!jpeg) {
+        return;
+    }
+
+    // Whatever is still queued was sent before this frame was published
+    if (c->send.len > 0) {
+        metrics_add(dropped_metric, 1);
+    } else {
+        mg_printf(c, "--" MJPEG_BOUNDARY "\r\n"
+                     "Content-Type: image/jpeg\r\n"
+                     "Content-Length: %zu\r\n\r\n", (size_t)jpeg->size);
+        mg_send(c, jpeg->data, jpeg->size);
+        mg_send(c, "\r\n", 2);
+        metrics_add(sent_metric, 1);
+    }
+    av_buffer_unref(&jpeg);
+}
+
+void mg_cancel_mjpeg(struct mg_connection *c) {
+    mjpeg_slot_t *slot = find_slot(c);
+    if (slot) {
+        mjpeg_broadcast_leave(slot->channel);
+        slot->used = false;
+    }
+    c->data[0] = '\0';
+}
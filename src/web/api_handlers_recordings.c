@@ -15,6 +15,7 @@
 #include "core/logger.h"
 #include "mongoose.h"
 #include "database/db_recordings.h"
+#include "storage/archive_worker.h"
 
 // Use MAX_PATH_LENGTH from config.h
 
@@ -135,9 +136,9 @@ void serve_direct_download(struct mg_connection *c, uint64_t id, recording_metad
                          "Pragma: no-cache\r\n"
                          "Expires: 0\r\n";
                          
-    // Check if file exists
+    // Check if file exists, on whichever storage tier holds it
     struct stat st;
-    if (stat(metadata->file_path, &st) != 0) {
+    if (locate_recording_file(metadata, &st) != 0) {
         mg_http_reply(c, 404, headers, "{\"error\": \"Recording file not found\"}");
         return;
     }
@@ -18,8 +18,50 @@
 #include "mongoose.h"
 #include "database/database_manager.h"
 #include "database/db_recordings.h"
+#include "storage/deletion_worker.h"
 #include "web/mongoose_server_multithreading.h"
 
+/**
+ * @brief Delete recordings in one transaction and add a result for each ID
+ *
+ * @param ids Recording IDs
+ * @param count Number of IDs
+ * @param results_array Array receiving a result object per ID
+ * @param success_count Incremented for each deleted recording
+ * @param error_count Incremented for each recording that was not deleted
+ */
+static void delete_recording_ids(const uint64_t *ids, int count, cJSON *results_array,
+                                 int *success_count, int *error_count) {
+    if (count <= 0) {
+        return;
+    }
+
+    // The files are unlinked by the deletion worker
+    bool *deleted = calloc(count, sizeof(bool));
+    int deleted_count = deleted ? delete_recordings_async(ids, count, deleted, NULL, NULL) : -1;
+    if (deleted_count < 0) {
+        log_error("Failed to delete %d recordings from database", count);
+    }
+
+    for (int i = 0; i < count; i++) {
+        cJSON *result = cJSON_CreateObject();
+        cJSON_AddNumberToObject(result, "id", ids[i]);
+        if (deleted_count >= 0 && deleted[i]) {
+            cJSON_AddBoolToObject(result, "success", true);
+            (*success_count)++;
+        } else {
+            cJSON_AddBoolToObject(result, "success", false);
+            cJSON_AddStringToObject(result, "error", deleted_count < 0 ? "Failed to delete from database"
+                                                                       : "Recording not found");
+            (*error_count)++;
+        }
+        cJSON_AddItemToArray(results_array, result);
+    }
+
+    log_info("Batch deleted %d of %d recordings", deleted_count < 0 ? 0 : deleted_count, count);
+    free(deleted);
+}
+
 /**
  * @brief Batch delete recordings task function
  *
@@ -71,75 +113,29 @@ void batch_delete_recordings_task_function(struct mg_connection *c, struct mg_ht
             return;
         }
 
-        // Process each ID
+        // Collect the valid IDs, which are deleted together
         int success_count = 0;
         int error_count = 0;
         cJSON *results_array = cJSON_CreateArray();
+        uint64_t *ids = malloc(array_size * sizeof(uint64_t));
+        int id_count = 0;
 
-        for (int i = 0; i < array_size; i++) {
+        for (int i = 0; i < array_size && ids; i++) {
             cJSON *id_item = cJSON_GetArrayItem(ids_array, i);
             if (!id_item || !cJSON_IsNumber(id_item)) {
                 log_warn("Invalid ID at index %d", i);
                 error_count++;
                 continue;
             }
+            ids[id_count++] = (uint64_t)id_item->valuedouble;
+        }
 
-            uint64_t id = (uint64_t)id_item->valuedouble;
-
-            // Get recording from database
-            recording_metadata_t recording;
-            if (get_recording_metadata_by_id(id, &recording) != 0) {
-                log_warn("Recording not found: %llu", (unsigned long long)id);
-
-                // Add result to array
-                cJSON *result = cJSON_CreateObject();
-                cJSON_AddNumberToObject(result, "id", id);
-                cJSON_AddBoolToObject(result, "success", false);
-                cJSON_AddStringToObject(result, "error", "Recording not found");
-                cJSON_AddItemToArray(results_array, result);
-
-                error_count++;
-                continue;
-            }
-
-            // First delete from database to prevent any other operations on this recording
-            if (delete_recording_metadata(id) != 0) {
-                log_error("Failed to delete recording from database: %llu", (unsigned long long)id);
-
-                // Add result to array
-                cJSON *result = cJSON_CreateObject();
-                cJSON_AddNumberToObject(result, "id", id);
-                cJSON_AddBoolToObject(result, "success", false);
-                cJSON_AddStringToObject(result, "error", "Failed to delete from database");
-                cJSON_AddItemToArray(results_array, result);
-
-                error_count++;
-            } else {
-                // Then delete the file after the database entry is gone
-                bool file_deleted = true;
-                // Make a copy of the file path before attempting to delete
-                char file_path_copy[256];
-                strncpy(file_path_copy, recording.file_path, sizeof(file_path_copy) - 1);
-                file_path_copy[sizeof(file_path_copy) - 1] = '\0';
-
-                if (unlink(file_path_copy) != 0) {
-                    log_warn("Failed to delete recording file: %s (errno: %d)", file_path_copy, errno);
-                    file_deleted = false;
-                } else {
-                    log_info("Deleted recording file: %s", file_path_copy);
-                }
-                // Add success result to array
-                cJSON *result = cJSON_CreateObject();
-                cJSON_AddNumberToObject(result, "id", id);
-                cJSON_AddBoolToObject(result, "success", true);
-                if (!file_deleted) {
-                    cJSON_AddStringToObject(result, "warning", "File not deleted but removed from database");
-                }
-                cJSON_AddItemToArray(results_array, result);
-
-                success_count++;
-                log_info("Successfully deleted recording: %llu", (unsigned long long)id);
-            }
+        if (ids) {
+            delete_recording_ids(ids, id_count, results_array, &success_count, &error_count);
+            free(ids);
+        } else {
+            log_error("Failed to allocate memory for recording IDs");
+            error_count = array_size;
         }
 
         // Create response
@@ -333,53 +329,20 @@ void batch_delete_recordings_task_function(struct mg_connection *c, struct mg_ht
             return;
         }
 
-        // Process each recording
+        // Delete all matching recordings together
         int success_count = 0;
         int error_count = 0;
         cJSON *results_array = cJSON_CreateArray();
-
-        for (int i = 0; i < count; i++) {
-            uint64_t id = recordings[i].id;
-
-            // First delete from database to prevent any other operations on this recording
-            if (delete_recording_metadata(id) != 0) {
-                log_error("Failed to delete recording from database: %llu", (unsigned long long)id);
-
-                // Add result to array
-                cJSON *result = cJSON_CreateObject();
-                cJSON_AddNumberToObject(result, "id", id);
-                cJSON_AddBoolToObject(result, "success", false);
-                cJSON_AddStringToObject(result, "error", "Failed to delete from database");
-                cJSON_AddItemToArray(results_array, result);
-
-                error_count++;
-            } else {
-                // Then delete the file after the database entry is gone
-                bool file_deleted = true;
-                // Make a copy of the file path before attempting to delete
-                char file_path_copy[256];
-                strncpy(file_path_copy, recordings[i].file_path, sizeof(file_path_copy) - 1);
-                file_path_copy[sizeof(file_path_copy) - 1] = '\0';
-
-                if (unlink(file_path_copy) != 0) {
-                    log_warn("Failed to delete recording file: %s (errno: %d)", file_path_copy, errno);
-                    file_deleted = false;
-                } else {
-                    log_info("Deleted recording file: %s", file_path_copy);
-                }
-
-                // Add success result to array
-                cJSON *result = cJSON_CreateObject();
-                cJSON_AddNumberToObject(result, "id", id);
-                cJSON_AddBoolToObject(result, "success", true);
-                if (!file_deleted) {
-                    cJSON_AddStringToObject(result, "warning", "File not deleted but removed from database");
-                }
-                cJSON_AddItemToArray(results_array, result);
-
-                success_count++;
-                log_info("Successfully deleted recording: %llu", (unsigned long long)id);
+        uint64_t *ids = malloc(count * sizeof(uint64_t));
+        if (ids) {
+            for (int i = 0; i < count; i++) {
+                ids[i] = recordings[i].id;
             }
+            delete_recording_ids(ids, count, results_array, &success_count, &error_count);
+            free(ids);
+        } else {
+            log_error("Failed to allocate memory for recording IDs");
+            error_count = count;
         }
 
         // Free recordings
@@ -436,30 +399,10 @@ void mg_handle_batch_delete_recordings(struct mg_connection *c, struct mg_http_m
     // This prevents the client from waiting for the deletion to complete
     mg_send_json_response(c, 202, "{\"success\":true,\"message\":\"Batch deletion in progress\"}");
 
-    // Create a thread data structure
-    struct mg_thread_data *data = calloc(1, sizeof(struct mg_thread_data));
-    if (!data) {
-        log_error("Failed to allocate memory for thread data");
-        mg_http_reply(c, 500, "", "Internal Server Error\n");
+    // Queue for a worker thread; errors have been answered already
+    if (!mg_offload_request(c, hm, batch_delete_recordings_task_function)) {
         return;
     }
 
-    // Copy the HTTP message
-    data->message = mg_strdup(hm->message);
-    if (data->message.len == 0) {
-        log_error("Failed to duplicate HTTP message");
-        free(data);
-        mg_http_reply(c, 500, "", "Internal Server Error\n");
-        return;
-    }
-
-    // Set connection ID, manager, and handler function
-    data->conn_id = c->id;
-    data->mgr = c->mgr;
-    data->handler_func = batch_delete_recordings_task_function;
-
-    // Start thread
-    mg_start_thread(mg_thread_function, data);
-
     log_info("Batch delete recordings task started in a worker thread");
 }
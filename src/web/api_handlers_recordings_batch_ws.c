@@ -16,6 +16,7 @@
 #include "web/websocket_bridge.h"
 #include "web/websocket_client.h"
 #include "web/websocket_handler.h"
+#include "web/websocket_manager.h"
 #include "web/api_handlers_recordings_batch_ws.h"
 #include "web/mongoose_server_websocket_utils.h"
 #include "web/mongoose_server_multithreading.h"
@@ -25,6 +26,7 @@
 #include "mongoose.h"
 #include "database/database_manager.h"
 #include "database/db_recordings.h"
+#include "storage/deletion_worker.h"
 
 /**
  * @brief Structure for batch delete recordings task with WebSocket support
@@ -126,8 +128,9 @@ void send_progress_update(struct mg_connection *conn, int current, int total,
     
     log_info("Sending progress update: %s", message);
     
-    // Send message directly using mongoose
-    mg_ws_send(conn, message, len, WEBSOCKET_OP_TEXT);
+    // Queued for the event loop, which owns the connection; a newer update
+    // supersedes an older one if the client falls behind
+    websocket_manager_send(conn, message, len, WS_DROP_OLDEST);
 }
 
 /**
@@ -172,9 +175,9 @@ void send_final_result(const char *client_id, bool success, int total,
     // Get client connection directly from pointer value stored in client_id string
     struct mg_connection *conn = NULL;
     if (sscanf(client_id, "%p", &conn) == 1 && conn) {
-        // Send message directly using mongoose
+        // Queued for the event loop, which owns the connection
         log_info("Sending final result to client %s", client_id);
-        mg_ws_send(conn, message, strlen(message), WEBSOCKET_OP_TEXT);
+        websocket_manager_send(conn, message, strlen(message), WS_DROP_OLDEST);
     } else {
         log_error("Invalid client ID or connection not found: %s", client_id);
     }
@@ -183,6 +186,82 @@ void send_final_result(const char *client_id, bool success, int total,
     free(message);
 }
 
+// Progress updates are coalesced to at most one per this many milliseconds
+#define PROGRESS_INTERVAL_MS 250
+
+typedef struct {
+    batch_delete_recordings_ws_task_t *task;
+    struct timespec last_sent;
+} batch_delete_progress_t;
+
+/**
+ * @brief Report deletion progress, unless an update went out very recently
+ */
+static void batch_delete_progress(int done, int total, void *opaque) {
+    batch_delete_progress_t *progress = (batch_delete_progress_t *)opaque;
+    if (!progress->task->use_websocket || !progress->task->conn) {
+        return;
+    }
+    
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long elapsed_ms = (now.tv_sec - progress->last_sent.tv_sec) * 1000 +
+                      (now.tv_nsec - progress->last_sent.tv_nsec) / 1000000;
+    if (done < total && elapsed_ms < PROGRESS_INTERVAL_MS) {
+        return;
+    }
+    progress->last_sent = now;
+    
+    char status[128];
+    // Nothing is final until the transaction commits, so only the position is reported
+    snprintf(status, sizeof(status), "Deleting recordings: %d of %d", done, total);
+    send_progress_update(progress->task->conn, done, total, 0, 0, status, false);
+}
+
+/**
+ * @brief Delete recordings in one transaction and add a result for each ID
+ * 
+ * Rows are deleted together and the files are left to the deletion worker.
+ * 
+ * @param task Task, for progress updates
+ * @param ids Recording IDs
+ * @param count Number of IDs
+ * @param results_array Array receiving a result object per ID
+ * @param success_count Incremented for each deleted recording
+ * @param error_count Incremented for each recording that was not deleted
+ */
+static void delete_recording_ids(batch_delete_recordings_ws_task_t *task, const uint64_t *ids, int count,
+                                 cJSON *results_array, int *success_count, int *error_count) {
+    if (count <= 0) {
+        return;
+    }
+    
+    bool *deleted = calloc(count, sizeof(bool));
+    batch_delete_progress_t progress = { .task = task };
+    int deleted_count = deleted ? delete_recordings_async(ids, count, deleted, batch_delete_progress, &progress) : -1;
+    if (deleted_count < 0) {
+        log_error("Failed to delete %d recordings from database", count);
+    }
+    
+    for (int i = 0; i < count; i++) {
+        cJSON *result = cJSON_CreateObject();
+        cJSON_AddNumberToObject(result, "id", ids[i]);
+        if (deleted_count >= 0 && deleted[i]) {
+            cJSON_AddBoolToObject(result, "success", true);
+            (*success_count)++;
+        } else {
+            cJSON_AddBoolToObject(result, "success", false);
+            cJSON_AddStringToObject(result, "error", deleted_count < 0 ? "Failed to delete from database"
+                                                                       : "Recording not found");
+            (*error_count)++;
+        }
+        cJSON_AddItemToArray(results_array, result);
+    }
+    
+    log_info("Batch deleted %d of %d recordings", deleted_count < 0 ? 0 : deleted_count, count);
+    free(deleted);
+}
+
 /**
  * @brief Batch delete recordings task function with WebSocket support
  * 
@@ -240,10 +319,12 @@ void batch_delete_recordings_ws_task_function(void *arg) {
             return;
         }
         
-        // Process each ID
+        // Collect the valid IDs, which are deleted together
         int success_count = 0;
         int error_count = 0;
         cJSON *results_array = cJSON_CreateArray();
+        uint64_t *ids = malloc(array_size * sizeof(uint64_t));
+        int id_count = 0;
         
         // Send initial progress update
         if (task->use_websocket && task->conn) {
@@ -251,109 +332,22 @@ void batch_delete_recordings_ws_task_function(void *arg) {
                                "Starting batch delete operation", false);
         }
         
-        for (int i = 0; i < array_size; i++) {
+        for (int i = 0; i < array_size && ids; i++) {
             cJSON *id_item = cJSON_GetArrayItem(ids_array, i);
             if (!id_item || !cJSON_IsNumber(id_item)) {
                 log_warn("Invalid ID at index %d", i);
                 error_count++;
-                
-                // Send progress update
-                if (task->use_websocket && task->conn) {
-                    char status[128];
-                    snprintf(status, sizeof(status), "Invalid ID at index %d", i);
-                    send_progress_update(task->conn, i + 1, array_size, 
-                                       success_count, error_count, status, false);
-                }
-                
                 continue;
             }
-            
-            uint64_t id = (uint64_t)id_item->valuedouble;
-            
-            // Get recording from database
-            recording_metadata_t recording;
-            if (get_recording_metadata_by_id(id, &recording) != 0) {
-                log_warn("Recording not found: %llu", (unsigned long long)id);
-                
-                // Add result to array
-                cJSON *result = cJSON_CreateObject();
-                cJSON_AddNumberToObject(result, "id", id);
-                cJSON_AddBoolToObject(result, "success", false);
-                cJSON_AddStringToObject(result, "error", "Recording not found");
-                cJSON_AddItemToArray(results_array, result);
-                
-                error_count++;
-                
-                // Send progress update
-                if (task->use_websocket && task->conn) {
-                    char status[128];
-                    snprintf(status, sizeof(status), "Recording not found: %llu", (unsigned long long)id);
-                    send_progress_update(task->conn, i + 1, array_size, 
-                                       success_count, error_count, status, false);
-                }
-                
-                continue;
-            }
-            
-            // Delete file
-            bool file_deleted = true;
-            if (unlink(recording.file_path) != 0) {
-                log_warn("Failed to delete recording file: %s", recording.file_path);
-                file_deleted = false;
-            } else {
-                log_info("Deleted recording file: %s", recording.file_path);
-            }
-            
-            // Delete from database
-            if (delete_recording_metadata(id) != 0) {
-                log_error("Failed to delete recording from database: %llu", (unsigned long long)id);
-                
-                // Add result to array
-                cJSON *result = cJSON_CreateObject();
-                cJSON_AddNumberToObject(result, "id", id);
-                cJSON_AddBoolToObject(result, "success", false);
-                cJSON_AddStringToObject(result, "error", "Failed to delete from database");
-                cJSON_AddItemToArray(results_array, result);
-                
-                error_count++;
-                
-                // Send progress update
-                if (task->use_websocket && task->conn) {
-                    char status[128];
-                    snprintf(status, sizeof(status), "Failed to delete recording %llu from database", 
-                           (unsigned long long)id);
-                    send_progress_update(task->conn, i + 1, array_size, 
-                                       success_count, error_count, status, false);
-                }
-            } else {
-                // Add success result to array
-                cJSON *result = cJSON_CreateObject();
-                cJSON_AddNumberToObject(result, "id", id);
-                cJSON_AddBoolToObject(result, "success", true);
-                if (!file_deleted) {
-                    cJSON_AddStringToObject(result, "warning", "File not deleted but removed from database");
-                }
-                cJSON_AddItemToArray(results_array, result);
-                
-                success_count++;
-                log_info("Successfully deleted recording: %llu", (unsigned long long)id);
-                
-            // Send progress update
-            if (task->use_websocket && task->conn) {
-                char status[128];
-                snprintf(status, sizeof(status), "Deleted recording %llu", (unsigned long long)id);
-                send_progress_update(task->conn, i + 1, array_size, 
-                                   success_count, error_count, status, false);
-                
-                // Add a small delay to ensure the WebSocket message is sent
-                usleep(5000);  // 5ms delay
-            }
-            }
-            
-            // Add a small delay to avoid overwhelming the WebSocket connection
-            if (task->use_websocket && task->conn) {
-                usleep(10000);  // 10ms delay
-            }
+            ids[id_count++] = (uint64_t)id_item->valuedouble;
+        }
+        
+        if (ids) {
+            delete_recording_ids(task, ids, id_count, results_array, &success_count, &error_count);
+            free(ids);
+        } else {
+            log_error("Failed to allocate memory for recording IDs");
+            error_count = array_size;
         }
         
         // Create response
@@ -611,70 +605,20 @@ void batch_delete_recordings_ws_task_function(void *arg) {
             return;
         }
         
-        // Process each recording
+        // Delete all matching recordings together
         int success_count = 0;
         int error_count = 0;
         cJSON *results_array = cJSON_CreateArray();
-        
-        for (int i = 0; i < count; i++) {
-            uint64_t id = recordings[i].id;
-            
-            // Delete file
-            bool file_deleted = true;
-            if (unlink(recordings[i].file_path) != 0) {
-                log_warn("Failed to delete recording file: %s", recordings[i].file_path);
-                file_deleted = false;
-            } else {
-                log_info("Deleted recording file: %s", recordings[i].file_path);
-            }
-            
-            // Delete from database
-            if (delete_recording_metadata(id) != 0) {
-                log_error("Failed to delete recording from database: %llu", (unsigned long long)id);
-                
-                // Add result to array
-                cJSON *result = cJSON_CreateObject();
-                cJSON_AddNumberToObject(result, "id", id);
-                cJSON_AddBoolToObject(result, "success", false);
-                cJSON_AddStringToObject(result, "error", "Failed to delete from database");
-                cJSON_AddItemToArray(results_array, result);
-                
-                error_count++;
-                
-                // Send progress update
-                if (task->use_websocket && task->conn) {
-                    char status[128];
-                    snprintf(status, sizeof(status), "Failed to delete recording %llu from database", 
-                           (unsigned long long)id);
-                    send_progress_update(task->conn, i + 1, count, 
-                                       success_count, error_count, status, false);
-                }
-            } else {
-                // Add success result to array
-                cJSON *result = cJSON_CreateObject();
-                cJSON_AddNumberToObject(result, "id", id);
-                cJSON_AddBoolToObject(result, "success", true);
-                if (!file_deleted) {
-                    cJSON_AddStringToObject(result, "warning", "File not deleted but removed from database");
-                }
-                cJSON_AddItemToArray(results_array, result);
-                
-                success_count++;
-                log_info("Successfully deleted recording: %llu", (unsigned long long)id);
-                
-                // Send progress update
-                if (task->use_websocket && task->conn) {
-                    char status[128];
-                    snprintf(status, sizeof(status), "Deleted recording %llu", (unsigned long long)id);
-                    send_progress_update(task->conn, i + 1, count, 
-                                       success_count, error_count, status, false);
-                }
-            }
-            
-            // Add a small delay to avoid overwhelming the WebSocket connection
-            if (task->use_websocket && task->conn) {
-                usleep(10000);  // 10ms delay
+        uint64_t *ids = malloc(count * sizeof(uint64_t));
+        if (ids) {
+            for (int i = 0; i < count; i++) {
+                ids[i] = recordings[i].id;
             }
+            delete_recording_ids(task, ids, count, results_array, &success_count, &error_count);
+            free(ids);
+        } else {
+            log_error("Failed to allocate memory for recording IDs");
+            error_count = count;
         }
         
         // Free recordings
@@ -1176,29 +1120,10 @@ void mg_handle_batch_delete_recordings_ws(struct mg_connection *c, struct mg_htt
     // Send an immediate response to the client before processing the deletion
     mg_send_json_response(c, 202, "{\"success\":true,\"message\":\"Batch deletion in progress\"}");
     
-    // Create a thread data structure
-    struct mg_thread_data *data = calloc(1, sizeof(struct mg_thread_data));
-    if (!data) {
-        log_error("Failed to allocate memory for thread data");
-        mg_http_reply(c, 500, "", "Internal Server Error\n");
+    // Queue for a worker thread; errors have been answered already
+    if (!mg_offload_request(c, hm, batch_delete_recordings_ws_handler)) {
         return;
     }
     
-    // Copy the HTTP message
-    data->message = mg_strdup(hm->message);
-    if (data->message.len == 0) {
-        log_error("Failed to duplicate HTTP message");
-        free(data);
-        return;
-    }
-    
-    // Set connection ID, manager, and handler function
-    data->conn_id = c->id;
-    data->mgr = c->mgr;
-    data->handler_func = batch_delete_recordings_ws_handler;
-    
-    // Start thread
-    mg_start_thread(mg_thread_function, data);
-    
     log_info("Batch delete recordings task started in a worker thread");
 }
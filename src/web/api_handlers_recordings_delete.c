@@ -19,6 +19,7 @@
 #include "database/database_manager.h"
 #include "database/db_recordings.h"
 #include "database/db_auth.h"
+#include "storage/deletion_worker.h"
 #include "web/mongoose_server_multithreading.h"
 
 // Forward declarations for batch delete functionality
@@ -104,25 +105,8 @@ void delete_recording_task_function(void *arg) {
         return;
     }
     
-    // Check if file exists before attempting to delete
-    struct stat st;
-    bool file_exists = (stat(recording.file_path, &st) == 0);
-    
-    // Delete file if it exists
-    if (file_exists) {
-        if (unlink(recording.file_path) != 0) {
-            log_warn("Failed to delete recording file: %s (error: %s)", 
-                    recording.file_path, strerror(errno));
-            // Continue anyway, we'll remove from database
-        } else {
-            log_info("Deleted recording file: %s", recording.file_path);
-        }
-    } else {
-        log_warn("Recording file does not exist: %s", recording.file_path);
-    }
-    
-    // Delete from database
-    if (delete_recording_metadata(id) != 0) {
+    // The file is unlinked by the deletion worker, which may take a while on slow storage
+    if (delete_recording_async(id) != 0) {
         log_error("Failed to delete recording from database: %llu", (unsigned long long)id);
         // Don't send response here - already sent 202
         delete_recording_task_free(task);
@@ -261,30 +245,11 @@ void mg_handle_delete_recording(struct mg_connection *c, struct mg_http_message
     // Send an immediate response to the client before processing the request
     mg_send_json_response(c, 202, "{\"success\":true,\"message\":\"Processing request\"}");
     
-    // Create a thread data structure
-    struct mg_thread_data *data = calloc(1, sizeof(struct mg_thread_data));
-    if (!data) {
-        log_error("Failed to allocate memory for thread data");
-        mg_http_reply(c, 500, "", "Internal Server Error\n");
+    // Queue for a worker thread; errors have been answered already
+    if (!mg_offload_request(c, hm, delete_recording_handler)) {
         return;
     }
     
-    // Copy the HTTP message
-    data->message = mg_strdup(hm->message);
-    if (data->message.len == 0) {
-        log_error("Failed to duplicate HTTP message");
-        free(data);
-        return;
-    }
-    
-    // Set connection ID, manager, and handler function
-    data->conn_id = c->id;
-    data->mgr = c->mgr;
-    data->handler_func = delete_recording_handler;
-    
-    // Start thread
-    mg_start_thread(mg_thread_function, data);
-    
     log_info("Delete recording task started in a worker thread");
 }
 
@@ -14,6 +14,7 @@
 #include "web/mongoose_adapter.h"
 #include "web/mongoose_server_auth.h"
 #include "web/http_server.h"
+#include "web/json_writer.h"
 #include "core/logger.h"
 #include "core/config.h"
 #include "mongoose.h"
@@ -72,6 +73,8 @@ void mg_handle_get_recordings_worker(struct mg_connection *c, struct mg_http_mes
     char sort_field[32] = "start_time";
     char sort_order[8] = "desc";
     int has_detection = 0;
+    char cursor_token[64] = {0};
+    bool with_count = true;
     
     // Parse query string
     char *param = strtok(query_string, "&");
@@ -92,6 +95,10 @@ void mg_handle_get_recordings_worker(struct mg_connection *c, struct mg_http_mes
             strncpy(sort_order, param + 6, sizeof(sort_order) - 1);
         } else if (strncmp(param, "detection=", 10) == 0) {
             has_detection = atoi(param + 10);
+        } else if (strncmp(param, "cursor=", 7) == 0) {
+            strncpy(cursor_token, param + 7, sizeof(cursor_token) - 1);
+        } else if (strncmp(param, "count=", 6) == 0) {
+            with_count = atoi(param + 6) != 0;
         }
         param = strtok(NULL, "&");
     }
@@ -104,13 +111,29 @@ void mg_handle_get_recordings_worker(struct mg_connection *c, struct mg_http_mes
     // Calculate offset from page and limit
     int offset = (page - 1) * limit;
     
+    // A cursor pages by (start_time, id); other sort fields fall back to the offset
+    bool sort_by_start_time = strcmp(sort_field, "start_time") == 0;
+    bool use_cursor = false;
+    recording_cursor_t cursor = {0};
+    if (cursor_token[0] != '\0') {
+        if (parse_recording_cursor(cursor_token, &cursor) != 0) {
+            mg_send_json_error(c, 400, "Invalid cursor");
+            return;
+        }
+        if (sort_by_start_time) {
+            use_cursor = true;
+        } else {
+            log_warn("Cursor ignored for recordings sorted by %s, using page %d", sort_field, page);
+        }
+    }
+    
     // Get recordings from database
     recording_metadata_t *recordings = NULL;
     int count = 0;
     int total_count = 0;
     
-    // Allocate memory for recordings
-    recordings = (recording_metadata_t *)malloc(limit * sizeof(recording_metadata_t));
+    // Allocate memory for recordings, and one more to tell whether a next page exists
+    recordings = (recording_metadata_t *)malloc((limit + 1) * sizeof(recording_metadata_t));
     if (!recordings) {
         log_error("Failed to allocate memory for recordings");
         mg_send_json_error(c, 500, "Failed to allocate memory for recordings");
@@ -181,10 +204,13 @@ void mg_handle_get_recordings_worker(struct mg_connection *c, struct mg_http_mes
         }
     }
     
-    // Get total count first (for pagination)
-    total_count = get_recording_count(start_time, end_time, 
-                                     stream_name[0] != '\0' ? stream_name : NULL,
-                                     has_detection);
+    // Get total count first (for pagination); clients scrolling on with a
+    // cursor already know it, and skip the count over the whole range
+    if (with_count) {
+        total_count = get_recording_count(start_time, end_time, 
+                                         stream_name[0] != '\0' ? stream_name : NULL,
+                                         has_detection);
+    }
     
     if (total_count < 0) {
         log_error("Failed to get total recording count from database");
@@ -194,10 +220,17 @@ void mg_handle_get_recordings_worker(struct mg_connection *c, struct mg_http_mes
     }
     
     // Get recordings with pagination
-    count = get_recording_metadata_paginated(start_time, end_time, 
-                                           stream_name[0] != '\0' ? stream_name : NULL,
-                                           has_detection, sort_field, sort_order,
-                                           recordings, limit, offset);
+    if (use_cursor) {
+        count = get_recording_metadata_after(start_time, end_time,
+                                             stream_name[0] != '\0' ? stream_name : NULL,
+                                             has_detection, sort_order, &cursor,
+                                             recordings, limit + 1);
+    } else {
+        count = get_recording_metadata_paginated(start_time, end_time, 
+                                               stream_name[0] != '\0' ? stream_name : NULL,
+                                               has_detection, sort_field, sort_order,
+                                               recordings, limit + 1, offset);
+    }
     
     if (count < 0) {
         log_error("Failed to get recordings from database");
@@ -206,69 +239,34 @@ void mg_handle_get_recordings_worker(struct mg_connection *c, struct mg_http_mes
         return;
     }
     
-    // Create response object with recordings array and pagination
-    cJSON *response = cJSON_CreateObject();
-    if (!response) {
-        log_error("Failed to create response JSON object");
-        free(recordings);
-        mg_send_json_error(c, 500, "Failed to create response JSON");
-        return;
+    // The extra row only tells that there is a next page
+    bool has_more = count > limit;
+    if (has_more) {
+        count = limit;
     }
     
-    // Create recordings array
-    cJSON *recordings_array = cJSON_CreateArray();
-    if (!recordings_array) {
-        log_error("Failed to create recordings JSON array");
-        free(recordings);
-        cJSON_Delete(response);
-        mg_send_json_error(c, 500, "Failed to create recordings JSON");
-        return;
-    }
-    
-    // Add recordings array to response
-    cJSON_AddItemToObject(response, "recordings", recordings_array);
-    
-    // Create pagination object
-    cJSON *pagination = cJSON_CreateObject();
-    if (!pagination) {
-        log_error("Failed to create pagination JSON object");
-        free(recordings);
-        cJSON_Delete(response);
-        mg_send_json_error(c, 500, "Failed to create pagination JSON");
-        return;
-    }
+    // Stream the response; no JSON tree or string of the whole list is built
+    json_writer_t writer;
+    json_writer_t *w = &writer;
     
-    // Add pagination info
-    int total_pages = (total_count + limit - 1) / limit; // Ceiling division
-    cJSON_AddNumberToObject(pagination, "page", page);
-    cJSON_AddNumberToObject(pagination, "pages", total_pages);
-    cJSON_AddNumberToObject(pagination, "total", total_count);
-    cJSON_AddNumberToObject(pagination, "limit", limit);
-    
-    // Add pagination object to response
-    cJSON_AddItemToObject(response, "pagination", pagination);
+    log_info("Sending JSON response for GET /api/recordings request");
+    json_writer_begin(w, c, 200);
+    json_write_object_start(w, NULL);
+    json_write_array_start(w, "recordings");
     
     // Add each recording to the array
     for (int i = 0; i < count; i++) {
-        cJSON *recording = cJSON_CreateObject();
-        if (!recording) {
-            log_error("Failed to create recording JSON object");
-            continue;
-        }
-        
         // Format timestamps in UTC
         char start_time_str[32] = {0};
         char end_time_str[32] = {0};
-        struct tm *tm_info;
+        struct tm tm_buf;
         
-        tm_info = gmtime(&recordings[i].start_time);
-        if (tm_info) {
-            strftime(start_time_str, sizeof(start_time_str), "%Y-%m-%d %H:%M:%S UTC", tm_info);
+        if (gmtime_r(&recordings[i].start_time, &tm_buf)) {
+            strftime(start_time_str, sizeof(start_time_str), "%Y-%m-%d %H:%M:%S UTC", &tm_buf);
         }
         
-        tm_info = gmtime(&recordings[i].end_time);
-        if (tm_info) {
-            strftime(end_time_str, sizeof(end_time_str), "%Y-%m-%d %H:%M:%S UTC", tm_info);
+        if (gmtime_r(&recordings[i].end_time, &tm_buf)) {
+            strftime(end_time_str, sizeof(end_time_str), "%Y-%m-%d %H:%M:%S UTC", &tm_buf);
         }
         
         // Calculate duration in seconds
@@ -286,37 +284,49 @@ void mg_handle_get_recordings_worker(struct mg_connection *c, struct mg_http_mes
             snprintf(size_str, sizeof(size_str), "%.1f GB", recordings[i].size_bytes / (1024.0 * 1024.0 * 1024.0));
         }
         
-        cJSON_AddNumberToObject(recording, "id", recordings[i].id);
-        cJSON_AddStringToObject(recording, "stream", recordings[i].stream_name);
-        cJSON_AddStringToObject(recording, "file_path", recordings[i].file_path);
-        cJSON_AddStringToObject(recording, "start_time", start_time_str);
-        cJSON_AddStringToObject(recording, "end_time", end_time_str);
-        cJSON_AddNumberToObject(recording, "duration", duration);
-        cJSON_AddStringToObject(recording, "size", size_str);
-        cJSON_AddBoolToObject(recording, "has_detection", false);
-        
-        cJSON_AddItemToArray(recordings_array, recording);
+        json_write_object_start(w, NULL);
+        json_write_number(w, "id", recordings[i].id);
+        json_write_string(w, "stream", recordings[i].stream_name);
+        json_write_string(w, "file_path", recordings[i].file_path);
+        json_write_string(w, "start_time", start_time_str);
+        json_write_string(w, "end_time", end_time_str);
+        json_write_number(w, "duration", duration);
+        json_write_string(w, "size", size_str);
+        json_write_bool(w, "has_detection", false);
+        json_write_object_end(w);
     }
     
-    // Free recordings
-    free(recordings);
+    json_write_array_end(w);
     
-    // Convert to string
-    char *json_str = cJSON_PrintUnformatted(response);
-    if (!json_str) {
-        log_error("Failed to convert response JSON to string");
-        cJSON_Delete(response);
-        mg_send_json_error(c, 500, "Failed to convert response JSON to string");
-        return;
+    // Add pagination info
+    int total_pages = (total_count + limit - 1) / limit; // Ceiling division
+    json_write_object_start(w, "pagination");
+    json_write_number(w, "page", page);
+    if (with_count) {
+        json_write_number(w, "pages", total_pages);
+        json_write_number(w, "total", total_count);
+    } else {
+        json_write_null(w, "pages");
+        json_write_null(w, "total");
     }
+    json_write_number(w, "limit", limit);
+    json_write_bool(w, "has_more", has_more);
+    
+    // A page sorted by start time with more after it can be continued with ?cursor=
+    if (sort_by_start_time && has_more) {
+        recording_cursor_t next = { recordings[count - 1].start_time, recordings[count - 1].id };
+        char next_cursor[RECORDING_CURSOR_SIZE];
+        format_recording_cursor(&next, next_cursor, sizeof(next_cursor));
+        json_write_string(w, "next_cursor", next_cursor);
+    } else {
+        json_write_null(w, "next_cursor");
+    }
+    json_write_object_end(w);
     
-    // Send response directly
-    log_info("Sending JSON response for GET /api/recordings request");
-    mg_send_json_response(c, 200, json_str);
+    json_write_object_end(w);
+    json_writer_end(w);
     
-    // Clean up
-    free(json_str);
-    cJSON_Delete(response);
+    free(recordings);
     
     log_info("Successfully handled GET /api/recordings request");
 }
@@ -0,0 +1,93 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <sys/stat.h>
+
+#include "web/api_handlers_recordings_thumbnails.h"
+#include "web/api_handlers.h"
+#include "web/http_server.h"
+#include "web/mongoose_server_auth.h"
+#include "core/config.h"
+#include "core/logger.h"
+#include "database/db_recordings.h"
+#include "database/db_compaction.h"
+#include "storage/archive_worker.h"
+#include "video/recording_thumbnails.h"
+#include "mongoose.h"
+
+// The files of a finished recording never change
+#define THUMBNAIL_CACHE_HEADERS "Cache-Control: private, max-age=31536000, immutable\r\n"
+
+/**
+ * Serve a file derived from a recording, queueing its generation if it is missing
+ */
+static void serve_recording_thumbnail(struct mg_connection *c, struct mg_http_message *hm,
+                                      const char *prefix, recording_thumbnail_kind_t kind) {
+    // Check authentication
+    http_server_t *server = (http_server_t *)c->fn_data;
+    if (server && server->config.auth_enabled) {
+        if (mongoose_server_basic_auth_check(hm, server) != 0) {
+            mg_send_json_error(c, 401, "Unauthorized");
+            return;
+        }
+    }
+
+    // Extract recording ID from URL; strtoull stops at a .jpg or .vtt suffix
+    char id_str[32];
+    if (mg_extract_path_param(hm, prefix, id_str, sizeof(id_str)) != 0) {
+        mg_send_json_error(c, 400, "Invalid request path");
+        return;
+    }
+    uint64_t id = strtoull(id_str, NULL, 10);
+    if (id == 0) {
+        mg_send_json_error(c, 400, "Invalid recording ID");
+        return;
+    }
+
+    recording_metadata_t recording = {0};
+    if (get_recording_metadata_by_id(id, &recording) != 0) {
+        mg_send_json_error(c, 404, "Recording not found");
+        return;
+    }
+
+    // A compacted recording keeps the thumbnails named after the file it had
+    compacted_recording_t place;
+    bool compacted = get_recording_compaction(recording.id, &place) == 1;
+
+    char path[MAX_PATH_LENGTH];
+    struct stat st;
+    if (recording_thumbnails_path(compacted ? place.source_path : recording.file_path, kind,
+                                  path, sizeof(path)) == 0 &&
+        stat(path, &st) == 0) {
+        struct mg_http_serve_opts opts = {
+            .mime_types = "jpg=image/jpeg,vtt=text/vtt",
+            .extra_headers = THUMBNAIL_CACHE_HEADERS
+        };
+        mg_http_serve_file(c, hm, path, &opts);
+        return;
+    }
+
+    // Made on first request for recordings from before thumbnails were enabled,
+    // or whose thumbnails were dropped when they moved to the archive
+    if (recording.is_complete && !compacted && locate_recording_file(&recording, &st) == 0) {
+        recording_thumbnails_queue(recording.id, recording.file_path);
+    }
+    mg_send_json_error(c, 404, "Thumbnail not available");
+}
+
+/**
+ * @brief Direct handler for GET /api/recordings/thumbnail/:id
+ */
+void mg_handle_get_recording_thumbnail(struct mg_connection *c, struct mg_http_message *hm) {
+    serve_recording_thumbnail(c, hm, "/api/recordings/thumbnail/", RECORDING_THUMBNAIL);
+}
+
+/**
+ * @brief Direct handler for GET /api/recordings/sprite/:id.vtt and :id.jpg
+ */
+void mg_handle_get_recording_sprite(struct mg_connection *c, struct mg_http_message *hm) {
+    bool vtt = hm->uri.len > 4 && strncmp(hm->uri.buf + hm->uri.len - 4, ".vtt", 4) == 0;
+    serve_recording_thumbnail(c, hm, "/api/recordings/sprite/",
+                              vtt ? RECORDING_SPRITE_VTT : RECORDING_SPRITE);
+}
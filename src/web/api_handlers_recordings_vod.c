@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <sys/stat.h>
+
+#include "web/api_handlers_recordings_vod.h"
+#include "web/api_handlers.h"
+#include "web/http_server.h"
+#include "web/mongoose_server_auth.h"
+#include "core/config.h"
+#include "core/logger.h"
+#include "database/db_recordings.h"
+#include "database/db_compaction.h"
+#include "storage/archive_worker.h"
+#include "video/recording_vod.h"
+#include "mongoose.h"
+
+#define VOD_PLAYLIST_NAME "index.m3u8"
+
+/**
+ * Send a playlist or media resource
+ */
+static void send_vod_data(struct mg_connection *c, const char *content_type, const char *cache_control,
+                          const void *data, size_t size) {
+    mg_printf(c,
+              "HTTP/1.1 200 OK\r\n"
+              "Content-Type: %s\r\n"
+              "Cache-Control: %s\r\n"
+              "Access-Control-Allow-Origin: *\r\n"
+              "Content-Length: %zu\r\n\r\n",
+              content_type, cache_control, size);
+    mg_send(c, data, size);
+}
+
+/**
+ * @brief Handler for GET /api/recordings/vod/:id/:file
+ */
+void mg_handle_get_recording_vod(struct mg_connection *c, struct mg_http_message *hm) {
+    // Check authentication
+    http_server_t *server = (http_server_t *)c->fn_data;
+    if (server && server->config.auth_enabled) {
+        if (mongoose_server_basic_auth_check(hm, server) != 0) {
+            mg_send_json_error(c, 401, "Unauthorized");
+            return;
+        }
+    }
+
+    // The parameter is "<id>/<file>"
+    char param[96];
+    if (mg_extract_path_param(hm, "/api/recordings/vod/", param, sizeof(param)) != 0) {
+        mg_send_json_error(c, 400, "Invalid request path");
+        return;
+    }
+    char *end = NULL;
+    uint64_t id = strtoull(param, &end, 10);
+    if (id == 0 || *end != '/' || end[1] == '\0') {
+        mg_send_json_error(c, 400, "Invalid request path");
+        return;
+    }
+    const char *file_name = end + 1;
+
+    recording_metadata_t recording = {0};
+    if (get_recording_metadata_by_id(id, &recording) != 0) {
+        mg_send_json_error(c, 404, "Recording not found");
+        return;
+    }
+    struct stat st;
+    if (locate_recording_file(&recording, &st) != 0) {
+        mg_send_json_error(c, 404, "Recording file not found");
+        return;
+    }
+
+    // A recording in progress still grows, so only finished ones may be cached
+    const char *cache_control = recording.is_complete ? "private, max-age=31536000, immutable" : "no-cache";
+
+    if (strcmp(file_name, VOD_PLAYLIST_NAME) == 0) {
+        // Players that cannot decode HEVC ask for ?codec=h264
+        char codec[16] = {0};
+        mg_http_get_var(&hm->query, "codec", codec, sizeof(codec));
+        recording_vod_item_t item = {
+            .id = recording.id,
+            .file_path = recording.file_path,
+            .start_time = recording.start_time,
+            .h264 = strcmp(codec, "h264") == 0
+        };
+
+        // A recording compacted into a shared file is its part of that file
+        compacted_recording_t place;
+        if (get_recording_compaction(recording.id, &place) == 1) {
+            item.start_time -= (time_t)(place.offset_ms / 1000);
+            item.from_ms = place.offset_ms;
+            item.to_ms = place.offset_ms + place.duration_ms;
+        }
+        size_t length = 0;
+        char *playlist = recording_vod_build_playlist(&item, 1, &length);
+        if (!playlist) {
+            mg_send_json_error(c, 404, "Recording has no playable media");
+            return;
+        }
+        send_vod_data(c, "application/vnd.apple.mpegurl", "no-cache", playlist, length);
+        free(playlist);
+        return;
+    }
+
+    AVBufferRef *data = NULL;
+    int ret = recording_vod_get_resource(recording.id, recording.file_path, file_name, &data);
+    if (ret == RECORDING_VOD_BUSY) {
+        mg_http_reply(c, 503, "Content-Type: application/json\r\nRetry-After: 2\r\n",
+                      "{\"error\": \"Transcoding busy\"}\n");
+        return;
+    }
+    if (ret != 0) {
+        log_debug("VOD resource not available: %llu/%s", (unsigned long long)id, file_name);
+        mg_send_json_error(c, 404, "VOD resource not found");
+        return;
+    }
+
+    const char *base_name = strrchr(file_name, '/');
+    base_name = base_name ? base_name + 1 : file_name;
+    const char *content_type = strcmp(base_name, RECORDING_VOD_INIT_NAME) == 0 ? "video/mp4" : "video/iso.segment";
+    send_vod_data(c, content_type, cache_control, data->data, (size_t)data->size);
+    av_buffer_unref(&data);
+}
@@ -9,6 +9,7 @@
 
 #include "web/api_handlers.h"
 #include "web/mongoose_adapter.h"
+#include "web/api_response_cache.h"
 #include "core/logger.h"
 #include "core/config.h"
 #include "database/db_core.h"
@@ -76,10 +77,8 @@ void mg_handle_get_settings(struct mg_connection *c, struct mg_http_message *hm)
     log_info("Successfully handled GET /api/settings request");
 }
 
-/**
- * @brief Direct handler for POST /api/settings
- */
-void mg_handle_post_settings(struct mg_connection *c, struct mg_http_message *hm) {
+// Apply the settings of a POST /api/settings request
+static void post_settings(struct mg_connection *c, struct mg_http_message *hm) {
     log_info("Handling POST /api/settings request");
     
     // Parse JSON from request body
@@ -197,10 +196,12 @@ void mg_handle_post_settings(struct mg_connection *c, struct mg_http_message *hm
     
     // Max streams
     cJSON *max_streams = cJSON_GetObjectItem(settings, "max_streams");
-    if (max_streams && cJSON_IsNumber(max_streams)) {
-        g_config.max_streams = max_streams->valueint;
-        settings_changed = true;
-        log_info("Updated max_streams: %d", g_config.max_streams);
+    if (max_streams && cJSON_IsNumber(max_streams) && max_streams->valueint != g_config.max_streams) {
+        // The stream tables keep their size until restart
+        if (request_max_streams(max_streams->valueint) == 0) {
+            settings_changed = true;
+            log_info("Updated max_streams: %d (takes effect after restart)", max_streams->valueint);
+        }
     }
     
     // Log file
@@ -518,8 +519,8 @@ void mg_handle_post_settings(struct mg_connection *c, struct mg_http_message *hm
         log_info("Starting all streams from the database after changing database path...");
         
         // Get all stream configurations from the database
-        stream_config_t db_streams[MAX_STREAMS];
-        int count = get_all_stream_configs(db_streams, MAX_STREAMS);
+        stream_config_t *db_streams = calloc(g_config.max_streams, sizeof(stream_config_t));
+        int count = db_streams ? get_all_stream_configs(db_streams, g_config.max_streams) : -1;
         
         if (count > 0) {
             log_info("Found %d streams in the database", count);
@@ -607,6 +608,7 @@ void mg_handle_post_settings(struct mg_connection *c, struct mg_http_message *hm
         } else {
             log_warn("No streams found in the database");
         }
+        free(db_streams);
         
         log_info("Database path changed successfully");
     }
@@ -682,3 +684,13 @@ void mg_handle_post_settings(struct mg_connection *c, struct mg_http_message *hm
     
     log_info("Successfully handled POST /api/settings request");
 }
+
+/**
+ * @brief Direct handler for POST /api/settings
+ */
+void mg_handle_post_settings(struct mg_connection *c, struct mg_http_message *hm) {
+    post_settings(c, hm);
+
+    // Settings may have changed even if the request failed part way
+    api_cache_settings_changed();
+}
@@ -0,0 +1,94 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "web/api_handlers_snapshot.h"
+#include "web/api_handlers.h"
+#include "core/config.h"
+#include "core/logger.h"
+#include "video/streams.h"
+#include "video/snapshot_cache.h"
+#include "mongoose.h"
+
+#define SNAPSHOT_SUFFIX "/snapshot.jpg"
+#define SNAPSHOT_MAX_WIDTH 3840
+#define SNAPSHOT_DEFAULT_QUALITY 75
+
+/**
+ * Read an integer query parameter, or return the default if it is absent
+ */
+static int get_int_var(struct mg_http_message *hm, const char *name, int def) {
+    char value[16];
+    if (mg_http_get_var(&hm->query, name, value, sizeof(value)) <= 0) {
+        return def;
+    }
+    return atoi(value);
+}
+
+/**
+ * @brief Handler for GET /api/streams/:name/snapshot.jpg
+ */
+void mg_handle_get_stream_snapshot(struct mg_connection *c, struct mg_http_message *hm) {
+    // Extract the stream name between the prefix and the suffix
+    char stream_id[MAX_STREAM_NAME * 3];
+    if (mg_extract_path_param(hm, "/api/streams/", stream_id, sizeof(stream_id)) != 0) {
+        mg_send_json_error(c, 400, "Invalid request path");
+        return;
+    }
+    size_t id_len = strlen(stream_id);
+    size_t suffix_len = strlen(SNAPSHOT_SUFFIX);
+    if (id_len <= suffix_len || strcmp(stream_id + id_len - suffix_len, SNAPSHOT_SUFFIX) != 0) {
+        mg_send_json_error(c, 400, "Invalid request path");
+        return;
+    }
+    stream_id[id_len - suffix_len] = '\0';
+
+    char decoded_id[MAX_STREAM_NAME];
+    mg_url_decode(stream_id, strlen(stream_id), decoded_id, sizeof(decoded_id), 0);
+
+    // Only existing streams get a cache entry
+    if (!get_stream_by_name(decoded_id)) {
+        mg_send_json_error(c, 404, "Stream not found");
+        return;
+    }
+
+    int width = get_int_var(hm, "width", 0);
+    if (width < 0) {
+        width = 0;
+    } else if (width > SNAPSHOT_MAX_WIDTH) {
+        width = SNAPSHOT_MAX_WIDTH;
+    }
+    int quality = get_int_var(hm, "quality", SNAPSHOT_DEFAULT_QUALITY);
+    if (quality < 1) {
+        quality = 1;
+    } else if (quality > 100) {
+        quality = 100;
+    }
+
+    AVBufferRef *jpeg = NULL;
+    time_t frame_time = 0;
+    int ret = snapshot_cache_get_jpeg(decoded_id, width, quality, &jpeg, &frame_time);
+    if (ret == 1) {
+        // The decoder starts supplying frames now that someone asked
+        mg_http_reply(c, 503, "Content-Type: application/json\r\nRetry-After: 1\r\n",
+                      "{\"error\": \"No frame available yet\"}\n");
+        return;
+    }
+    if (ret != 0) {
+        mg_send_json_error(c, 500, "Failed to create snapshot");
+        return;
+    }
+
+    struct tm tm_buf;
+    char last_modified[64];
+    strftime(last_modified, sizeof(last_modified), "%a, %d %b %Y %H:%M:%S GMT",
+             gmtime_r(&frame_time, &tm_buf));
+
+    mg_printf(c, "HTTP/1.1 200 OK\r\n"
+                 "Content-Type: image/jpeg\r\n"
+                 "Cache-Control: no-cache\r\n"
+                 "Last-Modified: %s\r\n"
+                 "Content-Length: %zu\r\n\r\n", last_modified, (size_t)jpeg->size);
+    mg_send(c, jpeg->data, jpeg->size);
+    av_buffer_unref(&jpeg);
+}
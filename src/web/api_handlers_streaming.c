@@ -2,14 +2,267 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdbool.h>
 #include <string.h>
 #include <sys/stat.h>
 #include "web/mongoose_adapter.h"
 #include "core/logger.h"
 #include "core/config.h"
 #include "web/http_server.h"
+#include "web/api_handlers.h"
+#include "web/mongoose_server_sendfile.h"
 #include "video/streams.h"
+#include "video/hls/hls_abr.h"
+#include "video/hls/hls_mosaic.h"
+#include "video/hls/hls_segment_index.h"
+#include "video/hls/hls_viewers.h"
 
+// Larger playlists are not read into memory
+#define MAX_PLAYLIST_FILE_SIZE (1024 * 1024)
+
+
+/**
+ * Send a playlist file read whole
+ * It is sent from memory with a Content-Length, so the response can be
+ * compressed, and a rewrite while it is read cannot cut it short.
+ */
+static void send_playlist_file(struct mg_connection *c, struct mg_http_message *hm, const char *path,
+                               const char *headers) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        mg_http_reply(c, 404, "", "{\"error\": \"HLS file not found or still being generated by FFmpeg\"}\n");
+        return;
+    }
+
+    size_t len = 0;
+    size_t capacity = 4096;
+    char *data = malloc(capacity);
+    while (data) {
+        len += fread(data + len, 1, capacity - len, file);
+        if (len < capacity || capacity >= MAX_PLAYLIST_FILE_SIZE) {
+            break;
+        }
+        char *grown = realloc(data, capacity * 2);
+        if (!grown) {
+            free(data);
+            data = NULL;
+            break;
+        }
+        data = grown;
+        capacity *= 2;
+    }
+    bool failed = ferror(file) || (data && len == capacity);
+    fclose(file);
+
+    if (!data || failed) {
+        free(data);
+        mg_http_reply(c, 500, "", "{\"error\": \"Failed to read HLS playlist\"}\n");
+        return;
+    }
+
+    mg_printf(c, "HTTP/1.1 200 OK\r\n%sContent-Length: %zu\r\n\r\n", headers, len);
+    if (mg_strcmp(hm->method, mg_str("HEAD")) != 0) {
+        mg_send(c, data, len);
+    }
+    free(data);
+}
+
+/**
+ * Build the path of an HLS file from the configured storage path
+ *
+ * @return 0 on success, -1 if the configuration is unavailable
+ */
+static int build_hls_file_path(const char *decoded_stream_name, const char *file_name,
+                               char *path, size_t path_size) {
+    // Get the config to find the storage path - make a local copy of needed values
+    config_t *global_config = get_streaming_config();
+    if (!global_config) {
+        log_error("Failed to get streaming configuration");
+        return -1;
+    }
+
+    // Make local copies of the storage paths to avoid race conditions
+    char storage_path[MAX_PATH_LENGTH] = {0};
+    char storage_path_hls[MAX_PATH_LENGTH] = {0};
+
+    // Copy the storage paths with bounds checking
+    strncpy(storage_path, global_config->storage_path, MAX_PATH_LENGTH - 1);
+    storage_path[MAX_PATH_LENGTH - 1] = '\0';
+
+    strncpy(storage_path_hls, global_config->storage_path_hls, MAX_PATH_LENGTH - 1);
+    storage_path_hls[MAX_PATH_LENGTH - 1] = '\0';
+
+    // Construct the full path to the HLS file
+    // Use storage_path_hls if specified, otherwise fall back to storage_path
+    if (storage_path_hls[0] != '\0') {
+        snprintf(path, path_size, "%s/hls/%s/%s",
+                storage_path_hls, decoded_stream_name, file_name);
+        log_info("Using HLS-specific storage path: %s", storage_path_hls);
+    } else {
+        snprintf(path, path_size, "%s/hls/%s/%s",
+                storage_path, decoded_stream_name, file_name);
+        log_info("Using default storage path for HLS: %s", storage_path);
+    }
+
+    return 0;
+}
+
+/**
+ * Serve a live HLS segment of a stream from the segment index
+ */
+bool mg_serve_indexed_hls_segment(struct mg_connection *c, struct mg_http_message *hm,
+                                  const char *stream_name, const char *file_name) {
+    bool is_m4s = strstr(file_name, ".m4s") != NULL;
+    if ((!is_m4s && !strstr(file_name, ".ts")) || !hls_segment_index_is_active(stream_name)) {
+        return false;
+    }
+
+    // A segment missing from the index is still being written or already deleted
+    hls_segment_info_t segment;
+    AVBufferRef *data = NULL;
+    if (hls_segment_index_find(stream_name, file_name, &segment, &data) != 0) {
+        log_info("HLS segment not available: %s/%s", stream_name, file_name);
+        mg_http_reply(c, 404, "", "{\"error\": \"HLS file not found or still being generated by FFmpeg\"}\n");
+        return true;
+    }
+
+    char headers[512];
+    snprintf(headers, sizeof(headers),
+        "Content-Type: %s\r\n"
+        "Cache-Control: no-cache, no-store, must-revalidate\r\n"
+        "Connection: close\r\n"
+        "Access-Control-Allow-Origin: *\r\n"
+        "Access-Control-Allow-Methods: GET, OPTIONS\r\n"
+        "Access-Control-Allow-Headers: Origin, Content-Type, Accept, Authorization\r\n",
+        is_m4s ? "video/iso.segment" : "video/mp2t");
+
+    if (!data) {
+        // Segment on disk, complete since the writer has closed it
+        mg_serve_file_zero_copy(c, hm, segment.path, headers);
+        return true;
+    }
+
+    // Segment kept in memory; our reference keeps the data valid while it is copied
+    // into the send buffer, even if the writer drops the segment meanwhile
+    log_debug("Serving HLS segment from memory: %s/%s (%d bytes)", stream_name, file_name, (int)data->size);
+    mg_printf(c, "HTTP/1.1 200 OK\r\n%sContent-Length: %lu\r\n\r\n", headers, (unsigned long)data->size);
+    if (mg_strcmp(hm->method, mg_str("HEAD")) != 0) {
+        mg_send(c, data->data, data->size);
+    }
+    av_buffer_unref(&data);
+    c->is_draining = 1;
+    return true;
+}
+
+// Headers of transcoded HLS files, with the content type to fill in
+static const char *transcoded_headers_fmt =
+    "Content-Type: %s\r\n"
+    "Cache-Control: no-cache, no-store, must-revalidate\r\n"
+    "Connection: close\r\n"
+    "Access-Control-Allow-Origin: *\r\n"
+    "Access-Control-Allow-Methods: GET, OPTIONS\r\n"
+    "Access-Control-Allow-Headers: Origin, Content-Type, Accept, Authorization\r\n";
+
+/**
+ * Serve a playlist or segment written by a transcoder
+ *
+ * @param starting Whether the transcoder was just started and has written nothing yet
+ */
+static void serve_transcoded_file(struct mg_connection *c, struct mg_http_message *hm,
+                                  const char *path, bool starting) {
+    bool is_playlist = strstr(path, ".m3u8") != NULL;
+    char headers[512];
+
+    struct stat st;
+    if (starting || stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+        // The playlist appears once the transcoder has written its first segment
+        if (is_playlist) {
+            mg_http_reply(c, 503, "Retry-After: 1\r\n", "{\"error\": \"Transcoding is starting\"}\n");
+        } else {
+            mg_http_reply(c, 404, "", "{\"error\": \"HLS file not found\"}\n");
+        }
+        return;
+    }
+
+    if (is_playlist) {
+        snprintf(headers, sizeof(headers), transcoded_headers_fmt, "application/vnd.apple.mpegurl");
+        mg_http_serve_file(c, hm, path, &(struct mg_http_serve_opts){
+            .mime_types = "",
+            .extra_headers = headers
+        });
+    } else {
+        snprintf(headers, sizeof(headers), transcoded_headers_fmt, "video/mp2t");
+        mg_serve_file_zero_copy(c, hm, path, headers);
+    }
+}
+
+/**
+ * Serve the master playlist and the transcoded renditions of a stream
+ */
+bool mg_handle_abr_hls_request(struct mg_connection *c, struct mg_http_message *hm,
+                               const char *stream_name, const char *file_name) {
+    if (strcmp(file_name, HLS_ABR_MASTER_PLAYLIST) == 0) {
+        char playlist[1024];
+        if (hls_abr_build_master_playlist(stream_name, playlist, sizeof(playlist)) < 0) {
+            mg_http_reply(c, 500, "", "{\"error\": \"Failed to build master playlist\"}\n");
+            return true;
+        }
+        char headers[512];
+        snprintf(headers, sizeof(headers), transcoded_headers_fmt, "application/vnd.apple.mpegurl");
+        mg_http_reply(c, 200, headers, "%s", playlist);
+        return true;
+    }
+
+    int height = 0;
+    if (!hls_abr_parse_path(file_name, &height)) {
+        return false;
+    }
+
+    int state = hls_abr_request(stream_name, height);
+    if (state < 0) {
+        mg_http_reply(c, 404, "", "{\"error\": \"Rendition not available\"}\n");
+        return true;
+    }
+
+    char path[MAX_PATH_LENGTH * 2];
+    if (build_hls_file_path(stream_name, file_name, path, sizeof(path)) != 0) {
+        mg_http_reply(c, 500, "", "{\"error\": \"Internal server error\"}\n");
+        return true;
+    }
+
+    serve_transcoded_file(c, hm, path, state > 0);
+    return true;
+}
+
+/**
+ * Serve the playlist and segments of the mosaic stream
+ */
+bool mg_handle_mosaic_hls_request(struct mg_connection *c, struct mg_http_message *hm,
+                                  const char *stream_name, const char *file_name) {
+    if (!hls_mosaic_is_name(stream_name)) {
+        return false;
+    }
+
+    // Only files directly in the mosaic directory
+    if (file_name[0] == '\0' || file_name[0] == '.' || strchr(file_name, '/') || strchr(file_name, '\\')) {
+        mg_http_reply(c, 400, "", "{\"error\": \"Invalid HLS path\"}\n");
+        return true;
+    }
+
+    int state = hls_mosaic_request();
+    if (state < 0) {
+        mg_http_reply(c, 404, "", "{\"error\": \"Mosaic not available\"}\n");
+        return true;
+    }
+
+    char dir[MAX_PATH_LENGTH];
+    char path[MAX_PATH_LENGTH * 2];
+    hls_mosaic_get_dir(dir, sizeof(dir));
+    snprintf(path, sizeof(path), "%s/%s", dir, file_name);
+
+    serve_transcoded_file(c, hm, path, state > 0);
+    return true;
+}
 
 void mg_handle_direct_hls_request(struct mg_connection *c, struct mg_http_message *hm) {
     if (!c || !hm) {
@@ -71,37 +324,23 @@ void mg_handle_direct_hls_request(struct mg_connection *c, struct mg_http_messag
         return;
     }
 
-    // Get the config to find the storage path - make a local copy of needed values
-    config_t *global_config = get_streaming_config();
-    if (!global_config) {
-        log_error("Failed to get streaming configuration");
-        mg_http_reply(c, 500, "", "{\"error\": \"Internal server error\"}\n");
+    // Every request keeps an on-demand stream's HLS output running
+    hls_viewers_touch(decoded_stream_name);
+
+    // Renditions are served by the transcoder, segments of streams written by our
+    // HLS writer come from the segment index
+    if (mg_handle_mosaic_hls_request(c, hm, decoded_stream_name, file_name) ||
+        mg_handle_abr_hls_request(c, hm, decoded_stream_name, file_name) ||
+        mg_handle_ll_hls_request(c, hm, decoded_stream_name, file_name) ||
+        mg_serve_indexed_hls_segment(c, hm, decoded_stream_name, file_name)) {
         return;
     }
 
-    // Make local copies of the storage paths to avoid race conditions
-    char storage_path[MAX_PATH_LENGTH] = {0};
-    char storage_path_hls[MAX_PATH_LENGTH] = {0};
-
-    // Copy the storage paths with bounds checking
-    strncpy(storage_path, global_config->storage_path, MAX_PATH_LENGTH - 1);
-    storage_path[MAX_PATH_LENGTH - 1] = '\0';
-
-    strncpy(storage_path_hls, global_config->storage_path_hls, MAX_PATH_LENGTH - 1);
-    storage_path_hls[MAX_PATH_LENGTH - 1] = '\0';
-
     // Construct the full path to the HLS file
     char hls_file_path[MAX_PATH_LENGTH * 2]; // Double the buffer size to avoid truncation
-
-    // Use storage_path_hls if specified, otherwise fall back to storage_path
-    if (storage_path_hls[0] != '\0') {
-        snprintf(hls_file_path, sizeof(hls_file_path), "%s/hls/%s/%s",
-                storage_path_hls, decoded_stream_name, file_name);
-        log_info("Using HLS-specific storage path: %s", storage_path_hls);
-    } else {
-        snprintf(hls_file_path, sizeof(hls_file_path), "%s/hls/%s/%s",
-                storage_path, decoded_stream_name, file_name);
-        log_info("Using default storage path for HLS: %s", storage_path);
+    if (build_hls_file_path(decoded_stream_name, file_name, hls_file_path, sizeof(hls_file_path)) != 0) {
+        mg_http_reply(c, 500, "", "{\"error\": \"Internal server error\"}\n");
+        return;
     }
 
     log_info("Serving HLS file directly: %s", hls_file_path);
@@ -149,14 +388,22 @@ void mg_handle_direct_hls_request(struct mg_connection *c, struct mg_http_messag
             "Access-Control-Allow-Headers: Origin, Content-Type, Accept, Authorization\r\n",
             content_type_header, cache_control);
 
-        mg_http_serve_file(c, hm, hls_file_path, &(struct mg_http_serve_opts){
-            .mime_types = "",
-            .extra_headers = headers
-        });
+        // Segments are sent zero-copy; playlists are small and may be rewritten in place
+        if (strstr(file_name, ".m3u8")) {
+            send_playlist_file(c, hm, hls_file_path, headers);
+        } else {
+            mg_serve_file_zero_copy(c, hm, hls_file_path, headers);
+        }
     } else {
         // File doesn't exist - let the client know
         log_info("HLS file not found: %s (waiting for FFmpeg to create it)", hls_file_path);
 
+        // An on-demand stream that was idle needs a segment before its playlist exists
+        if (strstr(file_name, ".m3u8") && hls_viewers_on_demand(decoded_stream_name)) {
+            mg_http_reply(c, 503, "Retry-After: 1\r\n", "{\"error\": \"HLS stream is starting\"}\n");
+            return;
+        }
+
         // Return a 404 with a message that indicates the file is being generated
         mg_http_reply(c, 404, "", "{\"error\": \"HLS file not found or still being generated by FFmpeg\"}\n");
     }
@@ -24,11 +24,18 @@ void mg_handle_get_streams(struct mg_connection *c, struct mg_http_message *hm)
     log_info("Handling GET /api/streams request");
     
     // Get all stream configurations from database
-    stream_config_t db_streams[MAX_STREAMS];
-    int count = get_all_stream_configs(db_streams, MAX_STREAMS);
+    stream_config_t *db_streams = calloc(g_config.max_streams, sizeof(stream_config_t));
+    if (!db_streams) {
+        log_error("Failed to allocate memory for stream configurations");
+        mg_send_json_error(c, 500, "Failed to get stream configurations");
+        return;
+    }
+    
+    int count = get_all_stream_configs(db_streams, g_config.max_streams);
     
     if (count < 0) {
         log_error("Failed to get stream configurations from database");
+        free(db_streams);
         mg_send_json_error(c, 500, "Failed to get stream configurations");
         return;
     }
@@ -37,6 +44,7 @@ void mg_handle_get_streams(struct mg_connection *c, struct mg_http_message *hm)
     cJSON *streams_array = cJSON_CreateArray();
     if (!streams_array) {
         log_error("Failed to create streams JSON array");
+        free(db_streams);
         mg_send_json_error(c, 500, "Failed to create streams JSON");
         return;
     }
@@ -46,6 +54,7 @@ void mg_handle_get_streams(struct mg_connection *c, struct mg_http_message *hm)
         cJSON *stream_obj = cJSON_CreateObject();
         if (!stream_obj) {
             log_error("Failed to create stream JSON object");
+            free(db_streams);
             cJSON_Delete(streams_array);
             mg_send_json_error(c, 500, "Failed to create stream JSON");
             return;
@@ -73,10 +82,20 @@ void mg_handle_get_streams(struct mg_connection *c, struct mg_http_message *hm)
         cJSON_AddNumberToObject(stream_obj, "detection_threshold", threshold_percent);
         
         cJSON_AddNumberToObject(stream_obj, "detection_interval", db_streams[i].detection_interval);
+        cJSON_AddNumberToObject(stream_obj, "detection_frame_step", db_streams[i].detection_frame_step);
+        cJSON_AddStringToObject(stream_obj, "detection_url", db_streams[i].detection_url);
+        cJSON_AddNumberToObject(stream_obj, "detection_motion_gate", (int)db_streams[i].detection_motion_gate);
+        cJSON_AddStringToObject(stream_obj, "detection_zones", db_streams[i].detection_zones);
+        cJSON_AddStringToObject(stream_obj, "motion_mask", db_streams[i].motion_mask);
         cJSON_AddNumberToObject(stream_obj, "pre_detection_buffer", db_streams[i].pre_detection_buffer);
         cJSON_AddNumberToObject(stream_obj, "post_detection_buffer", db_streams[i].post_detection_buffer);
         cJSON_AddNumberToObject(stream_obj, "protocol", (int)db_streams[i].protocol);
         cJSON_AddBoolToObject(stream_obj, "record_audio", db_streams[i].record_audio);
+        cJSON_AddNumberToObject(stream_obj, "retention_days", db_streams[i].retention_days);
+        cJSON_AddNumberToObject(stream_obj, "max_storage_bytes", (double)db_streams[i].max_storage_bytes);
+        cJSON_AddStringToObject(stream_obj, "retention_class", retention_class_name(db_streams[i].retention_class));
+        cJSON_AddStringToObject(stream_obj, "hls_segment_format",
+                                hls_segment_format_name(db_streams[i].hls_segment_format));
         cJSON_AddBoolToObject(stream_obj, "isOnvif", db_streams[i].is_onvif);
         
         // Get stream status
@@ -111,6 +130,8 @@ void mg_handle_get_streams(struct mg_connection *c, struct mg_http_message *hm)
         cJSON_AddItemToArray(streams_array, stream_obj);
     }
     
+    free(db_streams);
+    
     // Convert to string
     char *json_str = cJSON_PrintUnformatted(streams_array);
     if (!json_str) {
@@ -194,10 +215,19 @@ void mg_handle_get_stream(struct mg_connection *c, struct mg_http_message *hm) {
     cJSON_AddNumberToObject(stream_obj, "detection_threshold", threshold_percent);
     
     cJSON_AddNumberToObject(stream_obj, "detection_interval", config.detection_interval);
+    cJSON_AddNumberToObject(stream_obj, "detection_frame_step", config.detection_frame_step);
+    cJSON_AddStringToObject(stream_obj, "detection_url", config.detection_url);
+    cJSON_AddNumberToObject(stream_obj, "detection_motion_gate", (int)config.detection_motion_gate);
+    cJSON_AddStringToObject(stream_obj, "detection_zones", config.detection_zones);
+    cJSON_AddStringToObject(stream_obj, "motion_mask", config.motion_mask);
     cJSON_AddNumberToObject(stream_obj, "pre_detection_buffer", config.pre_detection_buffer);
     cJSON_AddNumberToObject(stream_obj, "post_detection_buffer", config.post_detection_buffer);
     cJSON_AddNumberToObject(stream_obj, "protocol", (int)config.protocol);
     cJSON_AddBoolToObject(stream_obj, "record_audio", config.record_audio);
+    cJSON_AddNumberToObject(stream_obj, "retention_days", config.retention_days);
+    cJSON_AddNumberToObject(stream_obj, "max_storage_bytes", (double)config.max_storage_bytes);
+    cJSON_AddStringToObject(stream_obj, "retention_class", retention_class_name(config.retention_class));
+    cJSON_AddStringToObject(stream_obj, "hls_segment_format", hls_segment_format_name(config.hls_segment_format));
     cJSON_AddBoolToObject(stream_obj, "isOnvif", config.is_onvif);
     
     // Get stream status
@@ -17,6 +17,9 @@
 #include "mongoose.h"
 #include "video/detection_stream.h"
 #include "video/detection_stream_thread.h"
+#include "video/detection_zones.h"
+#include "video/motion_detection.h"
+#include "video/stream_reconfig.h"
 #include "database/database_manager.h"
 #include "video/hls/hls_directory.h"
 #include "video/hls/hls_api.h"
@@ -25,6 +28,79 @@
 #include "video/go2rtc/go2rtc_integration.h"
 #include "video/go2rtc/go2rtc_api.h"
 
+/**
+ * Validate the detection zones of a request and store them in canonical form
+ *
+ * @param text Zones text from the request
+ * @param zones_text Receives the zones, MAX_DETECTION_ZONES_TEXT bytes
+ * @return true if the zones are valid
+ */
+static bool copy_detection_zones(const char *text, char *zones_text) {
+    detection_zone_t zones[MAX_DETECTION_ZONES];
+    int count = parse_detection_zones(text, zones, MAX_DETECTION_ZONES);
+    if (count < 0) {
+        return false;
+    }
+    return format_detection_zones(zones, count, zones_text, MAX_DETECTION_ZONES_TEXT) == 0;
+}
+
+/**
+ * Validate the motion mask of a request and store it in canonical form
+ *
+ * @param text Mask text from the request
+ * @param mask_text Receives the mask, MAX_MOTION_MASK_TEXT bytes
+ * @return true if the mask is valid
+ */
+static bool copy_motion_mask(const char *text, char *mask_text) {
+    uint32_t rows[MOTION_MASK_MAX_GRID];
+    int grid_size = parse_motion_mask(text, rows);
+    if (grid_size < 0) {
+        return false;
+    }
+    return format_motion_mask(grid_size, rows, mask_text, MAX_MOTION_MASK_TEXT) == 0;
+}
+
+/**
+ * Apply the retention settings of a request to a stream configuration
+ *
+ * @param stream_json Request body
+ * @param config Stream configuration to update
+ * @return true if any setting changed
+ */
+static bool apply_retention_settings(const cJSON *stream_json, stream_config_t *config) {
+    bool changed = false;
+
+    cJSON *retention_days = cJSON_GetObjectItem(stream_json, "retention_days");
+    if (retention_days && cJSON_IsNumber(retention_days) && retention_days->valueint >= 0 &&
+        retention_days->valueint != config->retention_days) {
+        config->retention_days = retention_days->valueint;
+        changed = true;
+    }
+
+    cJSON *max_storage_bytes = cJSON_GetObjectItem(stream_json, "max_storage_bytes");
+    if (max_storage_bytes && cJSON_IsNumber(max_storage_bytes) && max_storage_bytes->valuedouble >= 0 &&
+        (uint64_t)max_storage_bytes->valuedouble != config->max_storage_bytes) {
+        config->max_storage_bytes = (uint64_t)max_storage_bytes->valuedouble;
+        changed = true;
+    }
+
+    cJSON *retention_class = cJSON_GetObjectItem(stream_json, "retention_class");
+    if (retention_class && cJSON_IsString(retention_class)) {
+        retention_class_t new_class = parse_retention_class(retention_class->valuestring);
+        if (new_class != config->retention_class) {
+            config->retention_class = new_class;
+            changed = true;
+        }
+    }
+
+    if (changed) {
+        log_info("Retention of stream %s: %d days, quota %llu bytes, class %s",
+                 config->name, config->retention_days, (unsigned long long)config->max_storage_bytes,
+                 retention_class_name(config->retention_class));
+    }
+    return changed;
+}
+
 /**
  * @brief Direct handler for POST /api/streams
  */
@@ -143,6 +219,41 @@ void mg_handle_post_stream(struct mg_connection *c, struct mg_http_message *hm)
         config.detection_interval = detection_interval->valueint;
     }
 
+    cJSON *detection_frame_step = cJSON_GetObjectItem(stream_json, "detection_frame_step");
+    if (detection_frame_step && cJSON_IsNumber(detection_frame_step) && detection_frame_step->valueint >= 0) {
+        config.detection_frame_step = detection_frame_step->valueint;
+    }
+
+    cJSON *detection_url = cJSON_GetObjectItem(stream_json, "detection_url");
+    if (detection_url && cJSON_IsString(detection_url)) {
+        strncpy(config.detection_url, detection_url->valuestring, sizeof(config.detection_url) - 1);
+        config.detection_url[sizeof(config.detection_url) - 1] = '\0';
+    }
+
+    cJSON *detection_motion_gate = cJSON_GetObjectItem(stream_json, "detection_motion_gate");
+    if (detection_motion_gate && cJSON_IsNumber(detection_motion_gate) &&
+        detection_motion_gate->valueint >= MOTION_GATE_OFF && detection_motion_gate->valueint <= MOTION_GATE_REGION) {
+        config.detection_motion_gate = (motion_gate_t)detection_motion_gate->valueint;
+    }
+
+    cJSON *detection_zones = cJSON_GetObjectItem(stream_json, "detection_zones");
+    if (detection_zones && cJSON_IsString(detection_zones) &&
+        !copy_detection_zones(detection_zones->valuestring, config.detection_zones)) {
+        log_error("Invalid detection zones for stream %s: %s", config.name, detection_zones->valuestring);
+        cJSON_Delete(stream_json);
+        mg_send_json_error(c, 400, "Invalid detection_zones");
+        return;
+    }
+
+    cJSON *motion_mask = cJSON_GetObjectItem(stream_json, "motion_mask");
+    if (motion_mask && cJSON_IsString(motion_mask) &&
+        !copy_motion_mask(motion_mask->valuestring, config.motion_mask)) {
+        log_error("Invalid motion mask for stream %s: %s", config.name, motion_mask->valuestring);
+        cJSON_Delete(stream_json);
+        mg_send_json_error(c, 400, "Invalid motion_mask");
+        return;
+    }
+
     cJSON *pre_detection_buffer = cJSON_GetObjectItem(stream_json, "pre_detection_buffer");
     if (pre_detection_buffer && cJSON_IsNumber(pre_detection_buffer)) {
         config.pre_detection_buffer = pre_detection_buffer->valueint;
@@ -165,6 +276,13 @@ void mg_handle_post_stream(struct mg_connection *c, struct mg_http_message *hm)
                 config.record_audio ? "enabled" : "disabled", config.name);
     }
 
+    apply_retention_settings(stream_json, &config);
+
+    cJSON *hls_segment_format = cJSON_GetObjectItem(stream_json, "hls_segment_format");
+    if (hls_segment_format && cJSON_IsString(hls_segment_format)) {
+        config.hls_segment_format = parse_hls_segment_format(hls_segment_format->valuestring);
+    }
+
     // Check if isOnvif flag is set in the request
     cJSON *is_onvif = cJSON_GetObjectItem(stream_json, "isOnvif");
     if (is_onvif && cJSON_IsBool(is_onvif)) {
@@ -349,132 +467,142 @@ void mg_handle_put_stream(struct mg_connection *c, struct mg_http_message *hm) {
         return;
     }
 
-    // Update configuration with provided values
-    bool config_changed = false;
-    bool requires_restart = false;  // Flag for changes that require stream restart
-
-    // Save original values for comparison
-    char original_url[MAX_URL_LENGTH];
-    strncpy(original_url, config.url, MAX_URL_LENGTH - 1);
-    original_url[MAX_URL_LENGTH - 1] = '\0';
-
-    stream_protocol_t original_protocol = config.protocol;
+    // Keep the configuration the stream runs with, to work out what the request changes
+    stream_config_t original_config = config;
 
+    // Update configuration with provided values
     cJSON *url = cJSON_GetObjectItem(stream_json, "url");
     if (url && cJSON_IsString(url)) {
         if (strcmp(config.url, url->valuestring) != 0) {
             strncpy(config.url, url->valuestring, sizeof(config.url) - 1);
-            config_changed = true;
-            requires_restart = true;  // URL changes always require restart
-            log_info("URL changed from '%s' to '%s' - restart required", original_url, config.url);
+            log_info("URL changed from '%s' to '%s'", original_config.url, config.url);
         }
     }
 
     cJSON *enabled = cJSON_GetObjectItem(stream_json, "enabled");
     if (enabled && cJSON_IsBool(enabled)) {
         config.enabled = cJSON_IsTrue(enabled);
-        config_changed = true;
     }
 
     cJSON *streaming_enabled = cJSON_GetObjectItem(stream_json, "streaming_enabled");
     if (streaming_enabled && cJSON_IsBool(streaming_enabled)) {
         config.streaming_enabled = cJSON_IsTrue(streaming_enabled);
-        config_changed = true;
     }
 
     cJSON *width = cJSON_GetObjectItem(stream_json, "width");
     if (width && cJSON_IsNumber(width)) {
         config.width = width->valueint;
-        config_changed = true;
     }
 
     cJSON *height = cJSON_GetObjectItem(stream_json, "height");
     if (height && cJSON_IsNumber(height)) {
         config.height = height->valueint;
-        config_changed = true;
     }
 
     cJSON *fps = cJSON_GetObjectItem(stream_json, "fps");
     if (fps && cJSON_IsNumber(fps)) {
         config.fps = fps->valueint;
-        config_changed = true;
     }
 
     cJSON *codec = cJSON_GetObjectItem(stream_json, "codec");
     if (codec && cJSON_IsString(codec)) {
         strncpy(config.codec, codec->valuestring, sizeof(config.codec) - 1);
-        config_changed = true;
     }
 
     cJSON *priority = cJSON_GetObjectItem(stream_json, "priority");
     if (priority && cJSON_IsNumber(priority)) {
         config.priority = priority->valueint;
-        config_changed = true;
     }
 
     cJSON *record = cJSON_GetObjectItem(stream_json, "record");
     if (record && cJSON_IsBool(record)) {
         config.record = cJSON_IsTrue(record);
-        config_changed = true;
     }
 
     cJSON *segment_duration = cJSON_GetObjectItem(stream_json, "segment_duration");
     if (segment_duration && cJSON_IsNumber(segment_duration)) {
         config.segment_duration = segment_duration->valueint;
-        config_changed = true;
     }
 
     cJSON *detection_based_recording_json = cJSON_GetObjectItem(stream_json, "detection_based_recording");
-    bool detection_based_recording_value = false;
-    bool has_detection_based_recording = false;
     if (detection_based_recording_json && cJSON_IsBool(detection_based_recording_json)) {
-        detection_based_recording_value = cJSON_IsTrue(detection_based_recording_json);
-        has_detection_based_recording = true;
-        config.detection_based_recording = detection_based_recording_value;
-        config_changed = true;
+        config.detection_based_recording = cJSON_IsTrue(detection_based_recording_json);
     }
 
     cJSON *detection_model_json = cJSON_GetObjectItem(stream_json, "detection_model");
-    char detection_model_value[256] = {0};
-    bool has_detection_model = false;
     if (detection_model_json && cJSON_IsString(detection_model_json)) {
-        strncpy(detection_model_value, detection_model_json->valuestring, sizeof(detection_model_value) - 1);
-        has_detection_model = true;
-        strncpy(config.detection_model, detection_model_value, sizeof(config.detection_model) - 1);
-        config_changed = true;
+        strncpy(config.detection_model, detection_model_json->valuestring, sizeof(config.detection_model) - 1);
     }
 
     cJSON *detection_threshold_json = cJSON_GetObjectItem(stream_json, "detection_threshold");
-    float detection_threshold_value = 0.0f;
-    bool has_detection_threshold = false;
     if (detection_threshold_json && cJSON_IsNumber(detection_threshold_json)) {
         // Convert from percentage (0-100) to float (0.0-1.0)
-        detection_threshold_value = detection_threshold_json->valuedouble / 100.0f;
-        has_detection_threshold = true;
-        config.detection_threshold = detection_threshold_value;
-        config_changed = true;
+        config.detection_threshold = detection_threshold_json->valuedouble / 100.0f;
     }
 
     cJSON *detection_interval_json = cJSON_GetObjectItem(stream_json, "detection_interval");
-    int detection_interval_value = 0;
-    bool has_detection_interval = false;
     if (detection_interval_json && cJSON_IsNumber(detection_interval_json)) {
-        detection_interval_value = detection_interval_json->valueint;
-        has_detection_interval = true;
-        config.detection_interval = detection_interval_value;
-        config_changed = true;
+        config.detection_interval = detection_interval_json->valueint;
+    }
+
+    cJSON *detection_frame_step_json = cJSON_GetObjectItem(stream_json, "detection_frame_step");
+    if (detection_frame_step_json && cJSON_IsNumber(detection_frame_step_json) &&
+        detection_frame_step_json->valueint >= 0 &&
+        detection_frame_step_json->valueint != config.detection_frame_step) {
+        config.detection_frame_step = detection_frame_step_json->valueint;
+    }
+
+    cJSON *detection_url_json = cJSON_GetObjectItem(stream_json, "detection_url");
+    if (detection_url_json && cJSON_IsString(detection_url_json) &&
+        strcmp(detection_url_json->valuestring, config.detection_url) != 0) {
+        strncpy(config.detection_url, detection_url_json->valuestring, sizeof(config.detection_url) - 1);
+        config.detection_url[sizeof(config.detection_url) - 1] = '\0';
+    }
+
+    cJSON *detection_motion_gate_json = cJSON_GetObjectItem(stream_json, "detection_motion_gate");
+    if (detection_motion_gate_json && cJSON_IsNumber(detection_motion_gate_json) &&
+        detection_motion_gate_json->valueint >= MOTION_GATE_OFF &&
+        detection_motion_gate_json->valueint <= MOTION_GATE_REGION &&
+        detection_motion_gate_json->valueint != (int)config.detection_motion_gate) {
+        config.detection_motion_gate = (motion_gate_t)detection_motion_gate_json->valueint;
+    }
+
+    cJSON *detection_zones_json = cJSON_GetObjectItem(stream_json, "detection_zones");
+    if (detection_zones_json && cJSON_IsString(detection_zones_json)) {
+        char zones_text[MAX_DETECTION_ZONES_TEXT];
+        if (!copy_detection_zones(detection_zones_json->valuestring, zones_text)) {
+            log_error("Invalid detection zones for stream %s: %s", config.name, detection_zones_json->valuestring);
+            cJSON_Delete(stream_json);
+            mg_send_json_error(c, 400, "Invalid detection_zones");
+            return;
+        }
+        if (strcmp(zones_text, config.detection_zones) != 0) {
+            memcpy(config.detection_zones, zones_text, sizeof(config.detection_zones));
+        }
+    }
+
+    cJSON *motion_mask_json = cJSON_GetObjectItem(stream_json, "motion_mask");
+    if (motion_mask_json && cJSON_IsString(motion_mask_json)) {
+        char mask_text[MAX_MOTION_MASK_TEXT];
+        if (!copy_motion_mask(motion_mask_json->valuestring, mask_text)) {
+            log_error("Invalid motion mask for stream %s: %s", config.name, motion_mask_json->valuestring);
+            cJSON_Delete(stream_json);
+            mg_send_json_error(c, 400, "Invalid motion_mask");
+            return;
+        }
+        if (strcmp(mask_text, config.motion_mask) != 0) {
+            memcpy(config.motion_mask, mask_text, sizeof(config.motion_mask));
+        }
     }
 
     cJSON *pre_detection_buffer = cJSON_GetObjectItem(stream_json, "pre_detection_buffer");
     if (pre_detection_buffer && cJSON_IsNumber(pre_detection_buffer)) {
         config.pre_detection_buffer = pre_detection_buffer->valueint;
-        config_changed = true;
     }
 
     cJSON *post_detection_buffer = cJSON_GetObjectItem(stream_json, "post_detection_buffer");
     if (post_detection_buffer && cJSON_IsNumber(post_detection_buffer)) {
         config.post_detection_buffer = post_detection_buffer->valueint;
-        config_changed = true;
     }
 
     cJSON *record_audio = cJSON_GetObjectItem(stream_json, "record_audio");
@@ -482,23 +610,33 @@ void mg_handle_put_stream(struct mg_connection *c, struct mg_http_message *hm) {
         bool original_record_audio = config.record_audio;
         config.record_audio = cJSON_IsTrue(record_audio);
         if (original_record_audio != config.record_audio) {
-            config_changed = true;
-            requires_restart = true;  // Audio recording changes require restart
-            log_info("Audio recording changed from %s to %s - restart required",
+            log_info("Audio recording changed from %s to %s",
                     original_record_audio ? "enabled" : "disabled",
                     config.record_audio ? "enabled" : "disabled");
         }
     }
 
+    // Read by the retention engine from the database, so no restart
+    apply_retention_settings(stream_json, &config);
+
+    // Restarts the HLS output of the stream
+    cJSON *hls_segment_format = cJSON_GetObjectItem(stream_json, "hls_segment_format");
+    if (hls_segment_format && cJSON_IsString(hls_segment_format)) {
+        hls_segment_format_t new_format = parse_hls_segment_format(hls_segment_format->valuestring);
+        if (new_format != config.hls_segment_format) {
+            log_info("HLS segment format changed from %s to %s",
+                    hls_segment_format_name(config.hls_segment_format), hls_segment_format_name(new_format));
+            config.hls_segment_format = new_format;
+        }
+    }
+
     cJSON *protocol = cJSON_GetObjectItem(stream_json, "protocol");
     if (protocol && cJSON_IsNumber(protocol)) {
         stream_protocol_t new_protocol = (stream_protocol_t)protocol->valueint;
         if (config.protocol != new_protocol) {
             config.protocol = new_protocol;
-            config_changed = true;
-            requires_restart = true;  // Protocol changes always require restart
-            log_info("Protocol changed from %d to %d - restart required",
-                    original_protocol, config.protocol);
+            log_info("Protocol changed from %d to %d",
+                    original_config.protocol, config.protocol);
         }
     }
 
@@ -518,7 +656,6 @@ void mg_handle_put_stream(struct mg_connection *c, struct mg_http_message *hm) {
         log_info("ONVIF flag changed from %s to %s",
                 original_is_onvif ? "true" : "false",
                 config.is_onvif ? "true" : "false");
-        config_changed = true;
     }
 
     // If ONVIF flag is set, test the connection
@@ -591,6 +728,8 @@ void mg_handle_put_stream(struct mg_connection *c, struct mg_http_message *hm) {
                         log_error("Failed to enable stream %s: %s", decoded_id, sqlite3_errmsg(db));
                     } else {
                         log_info("Successfully enabled stream %s", decoded_id);
+                        stream_configs_changed();
+                        config.enabled = true;
 
                         // Get the stream configuration to register with go2rtc
                         stream_config_t stream_config;
@@ -639,246 +778,22 @@ void mg_handle_put_stream(struct mg_connection *c, struct mg_http_message *hm) {
     // Clean up JSON
     cJSON_Delete(stream_json);
 
+    // Values sent unchanged do not count, so resaving a form restarts nothing
+    unsigned int changes = stream_config_changes(&original_config, &config);
+    char changes_text[64];
+    describe_stream_changes(changes, changes_text, sizeof(changes_text));
+
     // Always update stream configuration in database, even if no changes detected
     // This ensures the database and memory state are in sync
-    log_info("Detection settings before update - Model: %s, Threshold: %.2f, Interval: %d, Pre-buffer: %d, Post-buffer: %d",
-             config.detection_model, config.detection_threshold, config.detection_interval,
-             config.pre_detection_buffer, config.post_detection_buffer);
-
-    // Check if stream is running - we'll need this information for detection settings changes
-    stream_status_t status = get_stream_status(stream);
-    bool is_running = (status == STREAM_STATUS_RUNNING || status == STREAM_STATUS_STARTING);
-
-    // Update stream configuration in database first
     if (update_stream_config(decoded_id, &config) != 0) {
         log_error("Failed to update stream configuration in database");
         mg_send_json_error(c, 500, "Failed to update stream configuration");
         return;
     }
 
-    // Force update of stream configuration in memory to ensure it matches the database
-    // This ensures the stream handle has the latest configuration
-
-    // IMPORTANT: Ensure the in-memory configuration is fully updated from the database
-    // This is critical for URL changes to take effect
-    stream_config_t updated_config;
-    if (get_stream_config(stream, &updated_config) != 0) {
-        log_error("Failed to refresh stream configuration from database for stream %s", config.name);
-        mg_send_json_error(c, 500, "Failed to refresh stream configuration");
-        return;
-    }
-
-    if (set_stream_detection_params(stream,
-                                   config.detection_interval,
-                                   config.detection_threshold,
-                                   config.pre_detection_buffer,
-                                   config.post_detection_buffer) != 0) {
-        log_warn("Failed to update detection parameters for stream %s", config.name);
-    }
-
-    if (set_stream_detection_recording(stream,
-                                      config.detection_based_recording,
-                                      config.detection_model) != 0) {
-        log_warn("Failed to update detection recording for stream %s", config.name);
-    }
-
-    // If detection settings were changed and the stream is running,
-    // we need to restart the stream to apply the new detection settings
-    if (config_changed &&
-        (has_detection_based_recording || has_detection_model ||
-         has_detection_threshold || has_detection_interval) &&
-        is_running && !requires_restart) {
-        log_info("Detection settings changed for stream %s, marking for restart to apply changes", config.name);
-        requires_restart = true;
-    }
-
-    // Update other stream properties in memory
-    if (set_stream_recording(stream, config.record) != 0) {
-        log_warn("Failed to update recording setting for stream %s", config.name);
-    }
-
-    if (set_stream_streaming_enabled(stream, config.streaming_enabled) != 0) {
-        log_warn("Failed to update streaming setting for stream %s", config.name);
-    }
-
-    // Handle detection thread management based on detection_based_recording setting
-    bool detection_enabled_changed = false;
-    bool detection_was_enabled = false;
-    bool detection_now_enabled = false;
-
-    // Check if detection_based_recording was changed in this request
-    if (has_detection_based_recording) {
-        detection_enabled_changed = true;
-        detection_was_enabled = !detection_based_recording_value; // Previous state was opposite
-        detection_now_enabled = detection_based_recording_value;  // New state
-    } else {
-        // If not explicitly changed in this request, use the current config value
-        detection_now_enabled = config.detection_based_recording;
-
-        // Check if a detection thread is already running
-        detection_was_enabled = is_stream_detection_thread_running(config.name);
-
-        // If detection is enabled in config but no thread is running, we need to start one
-        if (detection_now_enabled && !detection_was_enabled) {
-            log_info("Detection is enabled in config for stream %s but no thread is running", config.name);
-            detection_enabled_changed = true;
-            detection_was_enabled = false; // Force thread start below
-        }
-    }
-
-    // If detection was enabled and now disabled, stop the detection thread
-    if (detection_was_enabled && !detection_now_enabled) {
-        log_info("Detection disabled for stream %s, stopping detection thread", config.name);
-        if (stop_stream_detection_thread(config.name) != 0) {
-            log_warn("Failed to stop detection thread for stream %s", config.name);
-        } else {
-            log_info("Successfully stopped detection thread for stream %s", config.name);
-        }
-    }
-    // If detection was disabled and now enabled, start the detection thread
-    else if (!detection_was_enabled && detection_now_enabled) {
-        // Only start if we have a valid model and the stream is enabled
-        if (config.detection_model[0] != '\0' && config.enabled) {
-            log_info("Detection enabled for stream %s, starting detection thread with model %s",
-                    config.name, config.detection_model);
-
-            // Make sure the stream is registered with go2rtc
-            if (go2rtc_stream_is_ready()) {
-                // Check if the stream is already registered with go2rtc
-                if (!go2rtc_api_stream_exists(config.name)) {
-                    log_info("Registering stream %s with go2rtc after enabling detection", config.name);
-                    if (go2rtc_stream_register(config.name, config.url,
-                                             config.onvif_username[0] != '\0' ? config.onvif_username : NULL,
-                                             config.onvif_password[0] != '\0' ? config.onvif_password : NULL)) {
-                        log_info("Successfully registered stream %s with go2rtc", config.name);
-                    } else {
-                        log_warn("Failed to register stream %s with go2rtc", config.name);
-                    }
-                } else {
-                    log_info("Stream %s is already registered with go2rtc", config.name);
-                }
-            } else {
-                log_warn("go2rtc is not ready, stream %s will not be registered", config.name);
-            }
-
-            // Construct HLS directory path
-            char hls_dir[MAX_PATH_LENGTH];
-            snprintf(hls_dir, MAX_PATH_LENGTH, "/var/lib/lightnvr/recordings/hls/%s", config.name);
-
-            // Start detection thread
-            if (start_stream_detection_thread(config.name, config.detection_model,
-                                             config.detection_threshold,
-                                             config.detection_interval, hls_dir) != 0) {
-                log_warn("Failed to start detection thread for stream %s", config.name);
-            } else {
-                log_info("Successfully started detection thread for stream %s", config.name);
-            }
-        } else {
-            log_warn("Detection enabled for stream %s but no model specified or stream disabled", config.name);
-        }
-    }
-    // If detection settings changed but detection was already enabled, restart the thread with new settings
-    else if (detection_now_enabled && (has_detection_model || has_detection_threshold || has_detection_interval)) {
-        log_info("Detection settings changed for stream %s, restarting detection thread", config.name);
-
-        // Stop existing thread
-        if (stop_stream_detection_thread(config.name) != 0) {
-            log_warn("Failed to stop existing detection thread for stream %s", config.name);
-        }
-
-        // Start new thread with updated settings
-        if (config.detection_model[0] != '\0' && config.enabled) {
-            // Construct HLS directory path
-            char hls_dir[MAX_PATH_LENGTH];
-            snprintf(hls_dir, MAX_PATH_LENGTH, "/var/lib/lightnvr/recordings/hls/%s", config.name);
-
-            // Start detection thread
-            if (start_stream_detection_thread(config.name, config.detection_model,
-                                             config.detection_threshold,
-                                             config.detection_interval, hls_dir) != 0) {
-                log_warn("Failed to restart detection thread for stream %s", config.name);
-            } else {
-                log_info("Successfully restarted detection thread for stream %s", config.name);
-            }
-        }
-    }
-
-    log_info("Updated stream configuration in memory for stream %s", config.name);
-
-    // Verify the update by reading back the configuration
-    if (get_stream_config(stream, &updated_config) == 0) {
-        log_info("Detection settings after update - Model: %s, Threshold: %.2f, Interval: %d, Pre-buffer: %d, Post-buffer: %d",
-                 updated_config.detection_model, updated_config.detection_threshold, updated_config.detection_interval,
-                 updated_config.pre_detection_buffer, updated_config.post_detection_buffer);
-    }
-
-    // Restart stream if configuration changed and either:
-    // 1. Critical parameters requiring restart were changed (URL, protocol)
-    // 2. The stream is currently running
-    // Note: We already checked the stream status earlier
-
-    if (config_changed && (requires_restart || is_running)) {
-        log_info("Restarting stream %s (requires_restart=%s, is_running=%s)",
-                config.name,
-                requires_restart ? "true" : "false",
-                is_running ? "true" : "false");
-
-        // If URL or protocol changed, we need to force restart the HLS stream thread
-        bool url_changed = strcmp(original_url, config.url) != 0;
-        bool protocol_changed = original_protocol != config.protocol;
-
-        // First clear HLS segments if URL changed
-        if (url_changed) {
-            log_info("URL changed for stream %s, clearing HLS segments", config.name);
-            if (clear_stream_hls_segments(config.name) != 0) {
-                log_warn("Failed to clear HLS segments for stream %s", config.name);
-                // Continue anyway
-            }
-        }
-
-        // Stop stream if it's running
-        if (is_running) {
-            log_info("Stopping stream %s for restart", config.name);
-
-            // Stop stream
-            if (stop_stream(stream) != 0) {
-                log_error("Failed to stop stream: %s", decoded_id);
-                // Continue anyway
-            }
-
-            // Wait for stream to stop with increased timeout for critical parameter changes
-            int timeout = requires_restart ? 50 : 30; // 5 seconds for critical changes, 3 seconds otherwise
-            while (get_stream_status(stream) != STREAM_STATUS_STOPPED && timeout > 0) {
-                usleep(100000); // 100ms
-                timeout--;
-            }
-
-            if (timeout == 0) {
-                log_warn("Timeout waiting for stream %s to stop, continuing anyway", config.name);
-            }
-        }
-
-        // Start stream if enabled
-        if (config.enabled) {
-            log_info("Starting stream %s after configuration update", config.name);
-            if (start_stream(stream) != 0) {
-                log_error("Failed to restart stream: %s", decoded_id);
-                // Continue anyway
-            }
-
-            // If URL or protocol changed, force restart the HLS stream thread
-            if ((url_changed || protocol_changed) && config.streaming_enabled) {
-                log_info("URL or protocol changed for stream %s, force restarting HLS stream thread", config.name);
-                if (restart_hls_stream(config.name) != 0) {
-                    log_warn("Failed to force restart HLS stream for %s", config.name);
-                    // Continue anyway
-                } else {
-                    log_info("Successfully force restarted HLS stream for %s", config.name);
-                }
-            }
-        }
-    } else if (config_changed) {
-        log_info("Configuration changed for stream %s but restart not required", config.name);
+    // Restart only the parts of the stream the change touches
+    if (apply_stream_config_changes(stream, &original_config, &config, changes) != 0) {
+        log_warn("Some changes to stream %s could not be applied (changes: %s)", config.name, changes_text);
     }
 
     // Create success response using cJSON
@@ -890,6 +805,7 @@ void mg_handle_put_stream(struct mg_connection *c, struct mg_http_message *hm) {
     }
 
     cJSON_AddBoolToObject(success, "success", true);
+    cJSON_AddStringToObject(success, "changes", changes_text);
 
     // Add ONVIF detection result if applicable
     if (onvif_test_performed) {
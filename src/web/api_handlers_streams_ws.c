@@ -0,0 +1,379 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <math.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "web/api_handlers_streams_ws.h"
+#include "web/websocket_client.h"
+#include "web/websocket_manager.h"
+#include "web/mongoose_server_websocket_utils.h"
+#include "core/logger.h"
+#include "core/config.h"
+#include "video/stream_manager.h"
+#include "video/stream_state.h"
+#include "video/stream_ingest.h"
+#include "video/streams.h"
+#include "cJSON.h"
+
+// Milliseconds between checks of the stream state version
+#define STATUS_CHECK_MS 250
+
+// Milliseconds between samples of the counters, over which rates are taken
+#define STATUS_SAMPLE_MS 1000
+
+// Relative change of a rate that is published
+#define STATUS_RATE_CHANGE 0.1
+
+typedef struct {
+    char name[MAX_STREAM_NAME];
+    const char *state;
+    bool enabled;
+    bool connected;
+    bool recording;
+    double fps;
+    double bitrate;                 // kbit/s
+    uint64_t errors;
+    uint64_t reconnects;
+    time_t last_packet;
+
+    // Counters at the last sample, for the rates
+    uint64_t frames;
+    uint64_t bytes;
+    int64_t sampled_ms;
+} stream_status_entry_t;
+
+// Status last published, guarded by status_mutex
+static stream_status_entry_t published[MAX_STREAMS];
+static int published_count = 0;
+static pthread_mutex_t status_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_t publisher_thread;
+static bool publisher_running = false;
+static pthread_mutex_t publisher_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t publisher_cond = PTHREAD_COND_INITIALIZER;
+
+static int64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static const char *state_name(stream_state_t state) {
+    switch (state) {
+        case STREAM_STATE_INACTIVE: return "inactive";
+        case STREAM_STATE_STARTING: return "starting";
+        case STREAM_STATE_ACTIVE: return "active";
+        case STREAM_STATE_STOPPING: return "stopping";
+        case STREAM_STATE_ERROR: return "error";
+        case STREAM_STATE_RECONNECTING: return "reconnecting";
+        default: return "unknown";
+    }
+}
+
+static const stream_status_entry_t *find_entry(const stream_status_entry_t *entries, int count, const char *name) {
+    for (int i = 0; i < count; i++) {
+        if (strcmp(entries[i].name, name) == 0) {
+            return &entries[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Sample the status of all streams
+ * Rates are only taken when rates is set; otherwise those of the previous
+ * sample are kept, as a sample right after a state change covers too short
+ * a time.
+ *
+ * @return Number of streams
+ */
+static int sample_streams(stream_status_entry_t *entries, const stream_status_entry_t *previous,
+                          int previous_count, bool rates) {
+    int64_t sampled_ms = now_ms();
+    int count = 0;
+
+    for (int i = 0; i < MAX_STREAMS && count < MAX_STREAMS; i++) {
+        stream_handle_t stream = get_stream_by_index(i);
+        stream_config_t config;
+        if (!stream || get_stream_config(stream, &config) != 0) {
+            continue;
+        }
+
+        stream_status_entry_t *e = &entries[count++];
+        memset(e, 0, sizeof(*e));
+        strncpy(e->name, config.name, sizeof(e->name) - 1);
+        e->enabled = config.enabled;
+        e->state = "unknown";
+        e->recording = get_recording_state(config.name) == 1;
+
+        stream_state_manager_t *state = get_stream_state_by_name(config.name);
+        if (state) {
+            e->state = state_name(get_stream_operational_state(state));
+            e->errors = atomic_load_explicit(&state->errors, memory_order_relaxed);
+        }
+
+        // Relaxed loads of the ingest counters, no lock on the ingest thread
+        stream_ingest_stats_t ingest;
+        if (stream_ingest_get_stats(config.name, &ingest) == 0) {
+            e->connected = ingest.connected;
+            e->reconnects = (uint64_t)ingest.reconnects;
+            e->last_packet = ingest.last_packet_time;
+            e->frames = ingest.frames_read;
+            e->bytes = ingest.bytes_read;
+        }
+
+        const stream_status_entry_t *prev = find_entry(previous, previous_count, e->name);
+        if (!rates && prev) {
+            e->fps = prev->fps;
+            e->bitrate = prev->bitrate;
+            e->frames = prev->frames;
+            e->bytes = prev->bytes;
+            e->sampled_ms = prev->sampled_ms;
+            continue;
+        }
+        e->sampled_ms = sampled_ms;
+
+        // Counters start over when the input is reopened
+        if (prev && sampled_ms > prev->sampled_ms && e->frames >= prev->frames && e->bytes >= prev->bytes) {
+            double seconds = (double)(sampled_ms - prev->sampled_ms) / 1000.0;
+            e->fps = (double)(e->frames - prev->frames) / seconds;
+            e->bitrate = (double)(e->bytes - prev->bytes) * 8.0 / 1000.0 / seconds;
+        }
+    }
+    return count;
+}
+
+static bool rate_changed(double a, double b) {
+    if ((a == 0.0) != (b == 0.0)) {
+        return true;
+    }
+    return fabs(a - b) > STATUS_RATE_CHANGE * fmax(a, b);
+}
+
+static bool status_changed(const stream_status_entry_t *a, const stream_status_entry_t *b) {
+    return strcmp(a->state, b->state) != 0 || a->enabled != b->enabled || a->connected != b->connected ||
+           a->recording != b->recording || a->errors != b->errors || a->reconnects != b->reconnects ||
+           rate_changed(a->fps, b->fps) || rate_changed(a->bitrate, b->bitrate);
+}
+
+static void add_status(cJSON *array, const stream_status_entry_t *e) {
+    cJSON *obj = cJSON_CreateObject();
+    if (!obj) {
+        return;
+    }
+    cJSON_AddStringToObject(obj, "name", e->name);
+    cJSON_AddStringToObject(obj, "state", e->state);
+    cJSON_AddBoolToObject(obj, "enabled", e->enabled);
+    cJSON_AddBoolToObject(obj, "connected", e->connected);
+    cJSON_AddBoolToObject(obj, "recording", e->recording);
+    cJSON_AddNumberToObject(obj, "fps", round(e->fps * 10.0) / 10.0);
+    cJSON_AddNumberToObject(obj, "bitrate", round(e->bitrate));
+    cJSON_AddNumberToObject(obj, "errors", (double)e->errors);
+    cJSON_AddNumberToObject(obj, "reconnects", (double)e->reconnects);
+    cJSON_AddNumberToObject(obj, "last_packet", (double)e->last_packet);
+    cJSON_AddItemToArray(array, obj);
+}
+
+/**
+ * Publish the streams that changed since the last sample
+ */
+static void publish_changes(const stream_status_entry_t *current, int count,
+                            const stream_status_entry_t *previous, int previous_count) {
+    cJSON *payload = cJSON_CreateObject();
+    cJSON *streams = payload ? cJSON_AddArrayToObject(payload, "streams") : NULL;
+    cJSON *removed = payload ? cJSON_AddArrayToObject(payload, "removed") : NULL;
+    if (!streams || !removed) {
+        cJSON_Delete(payload);
+        return;
+    }
+
+    bool changed = false;
+    for (int i = 0; i < count; i++) {
+        const stream_status_entry_t *prev = find_entry(previous, previous_count, current[i].name);
+        if (!prev || status_changed(&current[i], prev)) {
+            add_status(streams, &current[i]);
+            changed = true;
+        }
+    }
+    for (int i = 0; i < previous_count; i++) {
+        if (!find_entry(current, count, previous[i].name)) {
+            cJSON_AddItemToArray(removed, cJSON_CreateString(previous[i].name));
+            changed = true;
+        }
+    }
+
+    char *str = changed ? cJSON_PrintUnformatted(payload) : NULL;
+    cJSON_Delete(payload);
+    if (!str) {
+        return;
+    }
+    char *message = mg_websocket_message_create("delta", STREAMS_STATUS_TOPIC, str);
+    free(str);
+    if (!message) {
+        return;
+    }
+
+    // Deltas build on each other, so a client missing one must subscribe
+    // again for a new snapshot
+    websocket_manager_publish(STREAMS_STATUS_TOPIC, message, strlen(message), WS_DROP_CLIENT);
+    mg_websocket_message_free(message);
+}
+
+static void *stream_status_func(void *arg) {
+    (void)arg;
+    pthread_setname_np(pthread_self(), "stream-status");
+
+    static stream_status_entry_t current[MAX_STREAMS];
+    static stream_status_entry_t previous[MAX_STREAMS];
+    int previous_count = 0;
+    uint64_t last_version = 0;
+    int64_t last_sample_ms = 0;
+    bool first = true;
+
+    pthread_mutex_lock(&publisher_mutex);
+    while (publisher_running) {
+        pthread_mutex_unlock(&publisher_mutex);
+
+        uint64_t version = get_stream_state_version();
+        int64_t now = now_ms();
+        bool rates = first || now - last_sample_ms >= STATUS_SAMPLE_MS;
+        if (rates || version != last_version) {
+            last_version = version;
+            if (rates) {
+                last_sample_ms = now;
+            }
+
+            int count = sample_streams(current, previous, previous_count, rates);
+            if (!first) {
+                publish_changes(current, count, previous, previous_count);
+            }
+            first = false;
+
+            // Changes are compared with what was published, so a slowly
+            // drifting rate is published once it drifted far enough
+            for (int i = 0; i < count; i++) {
+                const stream_status_entry_t *prev = find_entry(previous, previous_count, current[i].name);
+                if (prev && !status_changed(&current[i], prev)) {
+                    current[i].fps = prev->fps;
+                    current[i].bitrate = prev->bitrate;
+                }
+            }
+
+            pthread_mutex_lock(&status_mutex);
+            memcpy(published, current, (size_t)count * sizeof(stream_status_entry_t));
+            published_count = count;
+            pthread_mutex_unlock(&status_mutex);
+
+            memcpy(previous, current, (size_t)count * sizeof(stream_status_entry_t));
+            previous_count = count;
+        }
+
+        pthread_mutex_lock(&publisher_mutex);
+        if (!publisher_running) {
+            break;
+        }
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += STATUS_CHECK_MS * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&publisher_cond, &publisher_mutex, &deadline);
+    }
+    pthread_mutex_unlock(&publisher_mutex);
+
+    return NULL;
+}
+
+int stream_status_publisher_start(void) {
+    pthread_mutex_lock(&publisher_mutex);
+    if (publisher_running) {
+        pthread_mutex_unlock(&publisher_mutex);
+        return 0;
+    }
+
+    publisher_running = true;
+    if (pthread_create(&publisher_thread, NULL, stream_status_func, NULL) != 0) {
+        log_error("Failed to start stream status publisher thread");
+        publisher_running = false;
+        pthread_mutex_unlock(&publisher_mutex);
+        return -1;
+    }
+    pthread_mutex_unlock(&publisher_mutex);
+
+    log_info("Stream status publisher started");
+    return 0;
+}
+
+void stream_status_publisher_stop(void) {
+    pthread_mutex_lock(&publisher_mutex);
+    if (!publisher_running) {
+        pthread_mutex_unlock(&publisher_mutex);
+        return;
+    }
+    publisher_running = false;
+    pthread_cond_signal(&publisher_cond);
+    pthread_mutex_unlock(&publisher_mutex);
+
+    pthread_join(publisher_thread, NULL);
+    log_info("Stream status publisher stopped");
+}
+
+void websocket_handle_stream_status(const char *client_id, const char *message) {
+    if (!client_id || !message) {
+        log_error("Invalid parameters for websocket_handle_stream_status");
+        return;
+    }
+
+    cJSON *json = cJSON_Parse(message);
+    if (!json) {
+        log_error("Failed to parse stream status WebSocket message");
+        return;
+    }
+
+    cJSON *type = cJSON_GetObjectItem(json, "type");
+    if (!type || !cJSON_IsString(type)) {
+        log_warn("Invalid stream status WebSocket message from client %s", client_id);
+        cJSON_Delete(json);
+        return;
+    }
+
+    if (strcmp(type->valuestring, "subscribe") == 0) {
+        if (websocket_client_subscribe(client_id, STREAMS_STATUS_TOPIC)) {
+            // The snapshot the deltas that follow build on
+            cJSON *payload = cJSON_CreateObject();
+            cJSON *streams = payload ? cJSON_AddArrayToObject(payload, "streams") : NULL;
+            char *str = NULL;
+            if (streams) {
+                pthread_mutex_lock(&status_mutex);
+                for (int i = 0; i < published_count; i++) {
+                    add_status(streams, &published[i]);
+                }
+                pthread_mutex_unlock(&status_mutex);
+                str = cJSON_PrintUnformatted(payload);
+            }
+            cJSON_Delete(payload);
+
+            char *ack = str ? mg_websocket_message_create("ack", STREAMS_STATUS_TOPIC, str) : NULL;
+            free(str);
+            if (ack) {
+                mg_websocket_message_send_to_client(client_id, ack);
+                mg_websocket_message_free(ack);
+            }
+        }
+    } else if (strcmp(type->valuestring, "unsubscribe") == 0) {
+        websocket_client_unsubscribe(client_id, STREAMS_STATUS_TOPIC);
+    } else {
+        log_debug("Ignoring stream status WebSocket message of type %s", type->valuestring);
+    }
+
+    cJSON_Delete(json);
+}
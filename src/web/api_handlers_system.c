@@ -6,33 +6,33 @@
 #include <string.h>
 #include <ctype.h>
 #include <unistd.h>
-#include <sys/utsname.h>
-#include <sys/sysinfo.h>
-#include <sys/statvfs.h>
 #include <sys/types.h>
 #include <sys/socket.h>
-#include <netdb.h>
-#include <ifaddrs.h>
-#include <net/if.h>
 #include <arpa/inet.h>
 #include <fcntl.h>
 #include <errno.h>
 
 #include "web/api_handlers.h"
+#include "web/system_stats.h"
 #include "core/logger.h"
 #include "core/config.h"
 #include "core/version.h"
 #include "core/shutdown_coordinator.h"
+#include "core/device_profile.h"
+#include "utils/memory.h"
 #include "video/stream_manager.h"
+#include "video/packet_pool.h"
+#include "video/load_governor.h"
+#include "video/stream_startup.h"
+#include "video/thread_utils.h"
 #include "database/db_streams.h"
 #include "database/db_recordings.h"
+#include "database/db_integrity.h"
+#include "database/db_backup.h"
 #include "storage/storage_manager_streams.h"
 #include "storage/storage_manager_streams_cache.h"
 #include "mongoose.h"
 
-// External function from api_handlers_system_go2rtc.c
-extern bool get_go2rtc_memory_usage(unsigned long long *memory_usage);
-
 // External declarations
 extern bool daemon_mode;
 
@@ -43,9 +43,17 @@ extern int get_system_logs(char ***logs, int *count);
 
 /**
  * @brief Direct handler for GET /api/system/info
+ *
+ * Serializes the latest system stats sample; nothing here touches /proc, the
+ * disk or the database, so dashboards can poll it freely.
  */
 void mg_handle_get_system_info(struct mg_connection *c, struct mg_http_message *hm) {
-    log_info("Handling GET /api/system/info request");
+    log_debug("Handling GET /api/system/info request");
+
+    system_stats_t stats;
+    if (!system_stats_get(&stats)) {
+        log_debug("No system stats sampled yet, reporting zeros");
+    }
 
     // Create JSON object
     cJSON *info = cJSON_CreateObject();
@@ -58,467 +66,111 @@ void mg_handle_get_system_info(struct mg_connection *c, struct mg_http_message *
     // Add version information
     cJSON_AddStringToObject(info, "version", LIGHTNVR_VERSION_STRING);
 
-    // Get system information
-    struct utsname system_info;
-    if (uname(&system_info) == 0) {
-        // Create CPU object
-        cJSON *cpu = cJSON_CreateObject();
-        if (cpu) {
-            cJSON_AddStringToObject(cpu, "model", system_info.machine);
-
-            // Get CPU cores
-            int cores = sysconf(_SC_NPROCESSORS_ONLN);
-            cJSON_AddNumberToObject(cpu, "cores", cores);
-
-            // Calculate CPU usage (simplified)
-            double cpu_usage = 0.0;
-            FILE *fp = fopen("/proc/stat", "r");
-            if (fp) {
-                unsigned long user, nice, system, idle, iowait, irq, softirq;
-                if (fscanf(fp, "cpu %lu %lu %lu %lu %lu %lu %lu",
-                          &user, &nice, &system, &idle, &iowait, &irq, &softirq) == 7) {
-                    unsigned long total = user + nice + system + idle + iowait + irq + softirq;
-                    unsigned long active = user + nice + system + irq + softirq;
-                    cpu_usage = (double)active / (double)total * 100.0;
-                }
-                fclose(fp);
-            }
-            cJSON_AddNumberToObject(cpu, "usage", cpu_usage);
-
-            // Add CPU object to info
-            cJSON_AddItemToObject(info, "cpu", cpu);
-        }
+    cJSON *cpu = cJSON_CreateObject();
+    if (cpu) {
+        cJSON_AddStringToObject(cpu, "model", stats.cpu_model);
+        cJSON_AddNumberToObject(cpu, "cores", stats.cpu_cores);
+        cJSON_AddNumberToObject(cpu, "usage", stats.cpu_usage);
+        cJSON_AddItemToObject(info, "cpu", cpu);
     }
 
-    // Get system-wide memory information first
-    struct sysinfo sys_info;
-    unsigned long long system_total = 0;
-    unsigned long long system_free = 0;
-    unsigned long long system_used = 0;
-
-    if (sysinfo(&sys_info) == 0) {
-        // Calculate memory values in bytes
-        system_total = sys_info.totalram * sys_info.mem_unit;
-        system_free = sys_info.freeram * sys_info.mem_unit;
-        system_used = system_total - system_free;
-    }
-
-    // Get memory information for the LightNVR process
+    // Process memory is reported against the system total, which makes the
+    // usage simpler to understand
+    unsigned long long system_total = stats.system_memory_total;
     cJSON *memory = cJSON_CreateObject();
     if (memory) {
-        // Get process memory usage using /proc/self/status
-        FILE *fp = fopen("/proc/self/status", "r");
-        unsigned long vm_rss = 0;
-
-        if (fp) {
-            char line[256];
-            while (fgets(line, sizeof(line), fp)) {
-                if (strncmp(line, "VmRSS:", 6) == 0) {
-                    // VmRSS is in kB - actual physical memory used
-                    sscanf(line + 6, "%lu", &vm_rss);
-                    break;
-                }
-            }
-            fclose(fp);
-        }
-
-        // Convert kB to bytes
-        unsigned long long used = vm_rss * 1024;
-
-        // Use the system total memory as the total for LightNVR as well
-        // This makes it simpler to understand the memory usage
-        unsigned long long total = system_total;
-
-        // Calculate free as the difference between total and used
-        unsigned long long free = (total > used) ? (total - used) : 0;
-
-        cJSON_AddNumberToObject(memory, "total", total);
-        cJSON_AddNumberToObject(memory, "used", used);
-        cJSON_AddNumberToObject(memory, "free", free);
-
-        // Add memory object to info
+        cJSON_AddNumberToObject(memory, "total", system_total);
+        cJSON_AddNumberToObject(memory, "used", stats.process_memory);
+        cJSON_AddNumberToObject(memory, "free", system_total > stats.process_memory ? system_total - stats.process_memory : 0);
         cJSON_AddItemToObject(info, "memory", memory);
     }
 
-    // Get memory information for the go2rtc process
     cJSON *go2rtc_memory = cJSON_CreateObject();
     if (go2rtc_memory) {
-        unsigned long long go2rtc_used = 0;
-
-        // Try to get go2rtc memory usage
-        if (get_go2rtc_memory_usage(&go2rtc_used)) {
-            log_debug("go2rtc memory usage: %llu bytes", go2rtc_used);
-        } else {
-            log_warn("Failed to get go2rtc memory usage, using 0");
-        }
-
-        // Use the system total memory as the total for go2rtc as well
-        unsigned long long total = system_total;
-
-        // Calculate free as the difference between total and used
-        unsigned long long free = (total > go2rtc_used) ? (total - go2rtc_used) : 0;
-
-        cJSON_AddNumberToObject(go2rtc_memory, "total", total);
-        cJSON_AddNumberToObject(go2rtc_memory, "used", go2rtc_used);
-        cJSON_AddNumberToObject(go2rtc_memory, "free", free);
-
-        // Add go2rtc memory object to info
+        cJSON_AddNumberToObject(go2rtc_memory, "total", system_total);
+        cJSON_AddNumberToObject(go2rtc_memory, "used", stats.go2rtc_memory);
+        cJSON_AddNumberToObject(go2rtc_memory, "free", system_total > stats.go2rtc_memory ? system_total - stats.go2rtc_memory : 0);
         cJSON_AddItemToObject(info, "go2rtcMemory", go2rtc_memory);
     }
 
-    // Get system-wide memory information
     cJSON *system_memory = cJSON_CreateObject();
     if (system_memory) {
         cJSON_AddNumberToObject(system_memory, "total", system_total);
-        cJSON_AddNumberToObject(system_memory, "used", system_used);
-        cJSON_AddNumberToObject(system_memory, "free", system_free);
-
-        // Add system memory object to info
+        cJSON_AddNumberToObject(system_memory, "used", system_total - stats.system_memory_free);
+        cJSON_AddNumberToObject(system_memory, "free", stats.system_memory_free);
         cJSON_AddItemToObject(info, "systemMemory", system_memory);
     }
 
-    // Get uptime of the LightNVR process
-    // Use /proc/self/stat to get process start time
-    FILE *stat_file = fopen("/proc/self/stat", "r");
-    if (stat_file) {
-        // Fields in /proc/self/stat
-        char comm[256];
-        char state;
-        int ppid, pgrp, session, tty_nr, tpgid;
-        unsigned long flags, minflt, cminflt, majflt, cmajflt, utime, stime;
-        long cutime, cstime, priority, nice, num_threads, itrealvalue;
-        unsigned long long starttime;
-
-        // Read the stat file
-        fscanf(stat_file, "%*d %s %c %d %d %d %d %d %lu %lu %lu %lu %lu %lu %lu %ld %ld %ld %ld %ld %ld %llu",
-               comm, &state, &ppid, &pgrp, &session, &tty_nr, &tpgid,
-               &flags, &minflt, &cminflt, &majflt, &cmajflt, &utime, &stime,
-               &cutime, &cstime, &priority, &nice, &num_threads, &itrealvalue, &starttime);
-        fclose(stat_file);
-
-        // Get system uptime
-        FILE *uptime_file = fopen("/proc/uptime", "r");
-        double system_uptime = 0;
-        if (uptime_file) {
-            fscanf(uptime_file, "%lf", &system_uptime);
-            fclose(uptime_file);
-        }
-
-        // Calculate process uptime in seconds
-        // starttime is in clock ticks since system boot
-        // Convert to seconds by dividing by sysconf(_SC_CLK_TCK)
-        long clock_ticks = sysconf(_SC_CLK_TCK);
-        double process_uptime = system_uptime - ((double)starttime / clock_ticks);
-
-        // Add process uptime to info
-        cJSON_AddNumberToObject(info, "uptime", process_uptime);
-    } else {
-        // Fallback to system uptime if process uptime can't be determined
-        struct sysinfo sys_info;
-        if (sysinfo(&sys_info) == 0) {
-            cJSON_AddNumberToObject(info, "uptime", sys_info.uptime);
-        }
+    // Get packet/frame pool counters of the video pipeline
+    cJSON *packet_pools = cJSON_CreateObject();
+    if (packet_pools) {
+        packet_pool_stats_t pool_stats;
+        packet_pool_get_total_stats(&pool_stats);
+
+        cJSON_AddNumberToObject(packet_pools, "packetHits", (double)pool_stats.packet_hits);
+        cJSON_AddNumberToObject(packet_pools, "packetMisses", (double)pool_stats.packet_misses);
+        cJSON_AddNumberToObject(packet_pools, "frameHits", (double)pool_stats.frame_hits);
+        cJSON_AddNumberToObject(packet_pools, "frameMisses", (double)pool_stats.frame_misses);
+        cJSON_AddNumberToObject(packet_pools, "payloadHits", (double)pool_stats.payload_hits);
+        cJSON_AddNumberToObject(packet_pools, "payloadMisses", (double)pool_stats.payload_misses);
+        cJSON_AddNumberToObject(packet_pools, "packetsFree", pool_stats.packets_free);
+        cJSON_AddNumberToObject(packet_pools, "framesFree", pool_stats.frames_free);
+
+        cJSON_AddItemToObject(info, "packetPools", packet_pools);
     }
 
-    // Get disk information for the configured storage path
-    struct statvfs disk_info;
-    if (statvfs(g_config.storage_path, &disk_info) == 0) {
-        // Create disk object for LightNVR storage
+    cJSON_AddNumberToObject(info, "uptime", stats.uptime);
+
+    if (stats.have_disk) {
         cJSON *disk = cJSON_CreateObject();
         if (disk) {
-            // Calculate disk values in bytes for consistency
-            unsigned long long total = disk_info.f_blocks * disk_info.f_frsize;
-            unsigned long long free = disk_info.f_bfree * disk_info.f_frsize;
-
-            // Get actual usage of the storage directory
-            unsigned long long used = 0;
-            char command[512];
-            snprintf(command, sizeof(command), "du -sb %s 2>/dev/null | cut -f1", g_config.storage_path);
-            FILE *fp = popen(command, "r");
-            if (fp) {
-                if (fscanf(fp, "%llu", &used) != 1) {
-                    // If du command fails, fall back to statvfs calculation
-                    used = (disk_info.f_blocks - disk_info.f_bfree) * disk_info.f_frsize;
-                }
-                pclose(fp);
-            } else {
-                // Fallback if popen fails
-                used = (disk_info.f_blocks - disk_info.f_bfree) * disk_info.f_frsize;
-            }
-
-            cJSON_AddNumberToObject(disk, "total", total);
-            cJSON_AddNumberToObject(disk, "used", used);
-            cJSON_AddNumberToObject(disk, "free", free);
-
-            // Add disk object to info
+            cJSON_AddNumberToObject(disk, "total", stats.disk_total);
+            cJSON_AddNumberToObject(disk, "used", stats.storage_used);
+            cJSON_AddNumberToObject(disk, "free", stats.disk_free);
             cJSON_AddItemToObject(info, "disk", disk);
         }
+    }
 
-        // Create system-wide disk object
+    if (stats.have_system_disk) {
         cJSON *system_disk = cJSON_CreateObject();
         if (system_disk) {
-            // Get system-wide disk information
-            struct statvfs root_disk_info;
-            if (statvfs("/", &root_disk_info) == 0) {
-                unsigned long long total = root_disk_info.f_blocks * root_disk_info.f_frsize;
-                unsigned long long free = root_disk_info.f_bfree * root_disk_info.f_frsize;
-                unsigned long long used = total - free;
-
-                cJSON_AddNumberToObject(system_disk, "total", total);
-                cJSON_AddNumberToObject(system_disk, "used", used);
-                cJSON_AddNumberToObject(system_disk, "free", free);
-            }
-
-            // Add system disk object to info
+            cJSON_AddNumberToObject(system_disk, "total", stats.system_disk_total);
+            cJSON_AddNumberToObject(system_disk, "used", stats.system_disk_total - stats.system_disk_free);
+            cJSON_AddNumberToObject(system_disk, "free", stats.system_disk_free);
             cJSON_AddItemToObject(info, "systemDisk", system_disk);
         }
     }
 
-    // Create network object
     cJSON *network = cJSON_CreateObject();
     if (network) {
-        // Create interfaces array
         cJSON *interfaces = cJSON_CreateArray();
         if (interfaces) {
-            // Get network interfaces with IP addresses using getifaddrs
-            struct ifaddrs *ifaddr, *ifa;
-            int family;
-            char host[NI_MAXHOST];
-
-            if (getifaddrs(&ifaddr) == 0) {
-                // Walk through linked list, maintaining head pointer so we can free list later
-                for (ifa = ifaddr; ifa != NULL; ifa = ifa->ifa_next) {
-                    if (ifa->ifa_addr == NULL)
-                        continue;
-
-                    family = ifa->ifa_addr->sa_family;
-
-                    // Skip loopback interface
-                    if (strcmp(ifa->ifa_name, "lo") == 0)
-                        continue;
-
-                    // Check if this is an IPv4 address
-                    if (family == AF_INET) {
-                        // Get IP address
-                        int s = getnameinfo(ifa->ifa_addr, sizeof(struct sockaddr_in),
-                                           host, NI_MAXHOST, NULL, 0, NI_NUMERICHOST);
-                        if (s == 0) {
-                            // Check if we already have this interface in our array
-                            bool found = false;
-                            cJSON *existing_iface = NULL;
-
-                            for (int i = 0; i < cJSON_GetArraySize(interfaces); i++) {
-                                existing_iface = cJSON_GetArrayItem(interfaces, i);
-                                cJSON *name_obj = cJSON_GetObjectItem(existing_iface, "name");
-                                if (name_obj && name_obj->valuestring && strcmp(name_obj->valuestring, ifa->ifa_name) == 0) {
-                                    found = true;
-                                    break;
-                                }
-                            }
-
-                            if (!found) {
-                                // Create new interface object
-                                cJSON *iface = cJSON_CreateObject();
-                                if (iface) {
-                                    cJSON_AddStringToObject(iface, "name", ifa->ifa_name);
-                                    cJSON_AddStringToObject(iface, "address", host);
-
-                                    // Get MAC address (simplified)
-                                    char mac[128] = "Unknown";
-                                    char mac_path[256];
-                                    snprintf(mac_path, sizeof(mac_path), "/sys/class/net/%s/address", ifa->ifa_name);
-                                    FILE *mac_file = fopen(mac_path, "r");
-                                    if (mac_file) {
-                                        if (fgets(mac, sizeof(mac), mac_file)) {
-                                            // Remove newline
-                                            mac[strcspn(mac, "\n")] = 0;
-                                        }
-                                        fclose(mac_file);
-                                    }
-
-                                    cJSON_AddStringToObject(iface, "mac", mac);
-                                    cJSON_AddBoolToObject(iface, "up", (ifa->ifa_flags & IFF_UP) != 0);
-
-                                    cJSON_AddItemToArray(interfaces, iface);
-                                }
-                            }
-                        }
-                    }
-                }
-
-                freeifaddrs(ifaddr);
-            } else {
-                // Fallback to /proc/net/dev if getifaddrs fails
-                FILE *fp = fopen("/proc/net/dev", "r");
-                if (fp) {
-                    char line[256];
-                    // Skip header lines
-                    fgets(line, sizeof(line), fp);
-                    fgets(line, sizeof(line), fp);
-
-                    // Read interfaces
-                    while (fgets(line, sizeof(line), fp)) {
-                        char *name = strtok(line, ":");
-                        if (name) {
-                            // Trim whitespace
-                            while (*name == ' ') name++;
-
-                            // Skip loopback
-                            if (strcmp(name, "lo") != 0) {
-                                cJSON *iface = cJSON_CreateObject();
-                                if (iface) {
-                                    cJSON_AddStringToObject(iface, "name", name);
-
-                                    // Try to get IP address using ip command
-                                    char ip_cmd[256];
-                                    char ip_addr[128] = "Unknown";
-                                    snprintf(ip_cmd, sizeof(ip_cmd), "ip -4 addr show %s | grep -oP '(?<=inet\\s)\\d+(\\.\\d+){3}'", name);
-                                    FILE *ip_fp = popen(ip_cmd, "r");
-                                    if (ip_fp) {
-                                        if (fgets(ip_addr, sizeof(ip_addr), ip_fp)) {
-                                            // Remove newline
-                                            ip_addr[strcspn(ip_addr, "\n")] = 0;
-                                        }
-                                        pclose(ip_fp);
-                                    }
-
-                                    cJSON_AddStringToObject(iface, "address", ip_addr);
-
-                                    // Get MAC address
-                                    char mac[128] = "Unknown";
-                                    char mac_path[256];
-                                    snprintf(mac_path, sizeof(mac_path), "/sys/class/net/%s/address", name);
-                                    FILE *mac_file = fopen(mac_path, "r");
-                                    if (mac_file) {
-                                        if (fgets(mac, sizeof(mac), mac_file)) {
-                                            // Remove newline
-                                            mac[strcspn(mac, "\n")] = 0;
-                                        }
-                                        fclose(mac_file);
-                                    }
-
-                                    cJSON_AddStringToObject(iface, "mac", mac);
-
-                                    // Check if interface is up
-                                    char flags_path[256];
-                                    snprintf(flags_path, sizeof(flags_path), "/sys/class/net/%s/flags", name);
-                                    FILE *flags_file = fopen(flags_path, "r");
-                                    bool is_up = false;
-                                    if (flags_file) {
-                                        unsigned int flags;
-                                        if (fscanf(flags_file, "%x", &flags) == 1) {
-                                            is_up = (flags & 1) != 0; // IFF_UP is 0x1
-                                        }
-                                        fclose(flags_file);
-                                    }
-
-                                    cJSON_AddBoolToObject(iface, "up", is_up);
-
-                                    cJSON_AddItemToArray(interfaces, iface);
-                                }
-                            }
-                        }
-                    }
-                    fclose(fp);
+            for (int i = 0; i < stats.interface_count; i++) {
+                cJSON *iface = cJSON_CreateObject();
+                if (iface) {
+                    cJSON_AddStringToObject(iface, "name", stats.interfaces[i].name);
+                    cJSON_AddStringToObject(iface, "address", stats.interfaces[i].address);
+                    cJSON_AddStringToObject(iface, "mac", stats.interfaces[i].mac);
+                    cJSON_AddBoolToObject(iface, "up", stats.interfaces[i].up);
+                    cJSON_AddItemToArray(interfaces, iface);
                 }
             }
-
-            // Add interfaces array to network object
             cJSON_AddItemToObject(network, "interfaces", interfaces);
         }
-
-        // Add network object to info
         cJSON_AddItemToObject(info, "network", network);
     }
 
-    // Create streams object
     cJSON *streams_obj = cJSON_CreateObject();
     if (streams_obj) {
-        // Get count of enabled streams from the database
-        int enabled_streams = get_enabled_stream_count();
-        log_debug("Enabled streams count from database: %d", enabled_streams);
-
-        cJSON_AddNumberToObject(streams_obj, "active", enabled_streams);
+        cJSON_AddNumberToObject(streams_obj, "active", stats.enabled_streams);
         cJSON_AddNumberToObject(streams_obj, "total", g_config.max_streams);
-
-        // Add streams object to info
         cJSON_AddItemToObject(info, "streams", streams_obj);
     }
 
-    // Create recordings object
     cJSON *recordings = cJSON_CreateObject();
     if (recordings) {
-        // Get recordings count from database using the db_recordings function
-        int recording_count = 0;
-
-        // Use the get_recording_count function from db_recordings.h
-        // Parameters: start_time, end_time, stream_name, has_detection
-        // Pass 0 for start_time and end_time to get all recordings
-        // Pass NULL for stream_name to get recordings from all streams
-        // Pass 0 for has_detection to get all recordings regardless of detection status
-        recording_count = get_recording_count(0, 0, NULL, 0);
-        if (recording_count < 0) {
-            recording_count = 0; // Reset if query fails
-            log_error("Failed to get recording count from database");
-        }
-
-        // Get recordings size from storage directory
-        unsigned long long recording_size = 0;
-
-        // Check if we have a recordings directory
-        char recordings_dir[512];
-        snprintf(recordings_dir, sizeof(recordings_dir), "%s/", g_config.storage_path);
-
-        struct stat st;
-        if (stat(recordings_dir, &st) == 0 && S_ISDIR(st.st_mode)) {
-            // Get size of recordings directory using du command
-            char command[512];
-            snprintf(command, sizeof(command), "du -sb %s 2>/dev/null | cut -f1", recordings_dir);
-            log_debug("Executing command: %s", command);
-
-            FILE *fp = popen(command, "r");
-            if (fp) {
-                if (fscanf(fp, "%llu", &recording_size) != 1) {
-                    log_error("Failed to parse du command output");
-                    recording_size = 0;
-                } else {
-                    log_debug("Recordings size from du command: %llu bytes", recording_size);
-                }
-                pclose(fp);
-            } else {
-                log_error("Failed to execute du command");
-            }
-
-            // If du command failed, try to get size using stat
-            if (recording_size == 0) {
-                log_debug("Trying to get recordings size using stat");
-
-                // Use a different approach - recursively list all files and sum their sizes
-                char find_command[512];
-                snprintf(find_command, sizeof(find_command),
-                        "find %s -type f -name \"*.mp4\" -exec stat -c %%s {} \\; | awk '{sum+=$1} END {print sum}'",
-                        recordings_dir);
-                log_debug("Executing command: %s", find_command);
-
-                FILE *find_fp = popen(find_command, "r");
-                if (find_fp) {
-                    if (fscanf(find_fp, "%llu", &recording_size) != 1) {
-                        log_error("Failed to parse find command output");
-                        recording_size = 0;
-                    } else {
-                        log_debug("Recordings size from find command: %llu bytes", recording_size);
-                    }
-                    pclose(find_fp);
-                } else {
-                    log_error("Failed to execute find command");
-                }
-            }
-        }
-
-        cJSON_AddNumberToObject(recordings, "count", recording_count);
-        cJSON_AddNumberToObject(recordings, "size", recording_size);
-
-        // Add recordings object to info
+        cJSON_AddNumberToObject(recordings, "count", stats.recording_count);
+        cJSON_AddNumberToObject(recordings, "size", stats.storage_used);
         cJSON_AddItemToObject(info, "recordings", recordings);
     }
 
@@ -540,8 +192,6 @@ void mg_handle_get_system_info(struct mg_connection *c, struct mg_http_message *
     // Clean up
     free(json_str);
     cJSON_Delete(info);
-
-    log_info("Successfully handled GET /api/system/info request");
 }
 
 /**
@@ -881,3 +531,409 @@ void mg_handle_get_system_status(struct mg_connection *c, struct mg_http_message
 
     log_info("Successfully handled GET /api/system/status request");
 }
+
+/**
+ * @brief Direct handler for GET /api/system/load-shedding
+ */
+void mg_handle_get_load_shedding(struct mg_connection *c, struct mg_http_message *hm) {
+    log_debug("Handling GET /api/system/load-shedding request");
+
+    load_governor_status_t status;
+    load_governor_get_status(&status);
+
+    load_shed_event_t events[LOAD_SHED_MAX_EVENTS];
+    int event_count = load_governor_get_events(events, LOAD_SHED_MAX_EVENTS);
+
+    cJSON *response = cJSON_CreateObject();
+    if (!response) {
+        log_error("Failed to create load shedding JSON object");
+        mg_send_json_error(c, 500, "Failed to create load shedding JSON");
+        return;
+    }
+
+    cJSON_AddBoolToObject(response, "enabled", status.enabled);
+    cJSON_AddStringToObject(response, "level", load_shed_level_name(status.level));
+    cJSON_AddNumberToObject(response, "cpu_usage", status.cpu_usage);
+    cJSON_AddNumberToObject(response, "memory_usage", status.memory_usage);
+    cJSON_AddNumberToObject(response, "process_memory", (double)status.process_memory);
+
+    cJSON *thresholds = cJSON_AddObjectToObject(response, "thresholds");
+    if (thresholds) {
+        cJSON_AddNumberToObject(thresholds, "cpu_high", g_config.load_shed_cpu_high);
+        cJSON_AddNumberToObject(thresholds, "cpu_low", g_config.load_shed_cpu_low);
+        cJSON_AddNumberToObject(thresholds, "memory_high", g_config.load_shed_memory_high);
+        cJSON_AddNumberToObject(thresholds, "memory_low", g_config.load_shed_memory_low);
+        cJSON_AddNumberToObject(thresholds, "pause_priority", g_config.load_shed_pause_priority);
+    }
+
+    cJSON *events_array = cJSON_AddArrayToObject(response, "events");
+    for (int i = 0; events_array && i < event_count; i++) {
+        cJSON *event = cJSON_CreateObject();
+        if (!event) {
+            break;
+        }
+        cJSON_AddNumberToObject(event, "time", (double)events[i].time);
+        cJSON_AddStringToObject(event, "level", load_shed_level_name(events[i].level));
+        cJSON_AddStringToObject(event, "previous", load_shed_level_name(events[i].previous));
+        cJSON_AddNumberToObject(event, "cpu_usage", events[i].cpu_usage);
+        cJSON_AddNumberToObject(event, "memory_usage", events[i].memory_usage);
+        cJSON_AddItemToArray(events_array, event);
+    }
+
+    char *json_str = cJSON_PrintUnformatted(response);
+    cJSON_Delete(response);
+    if (!json_str) {
+        log_error("Failed to convert load shedding JSON to string");
+        mg_send_json_error(c, 500, "Failed to convert load shedding JSON to string");
+        return;
+    }
+
+    mg_send_json_response(c, 200, json_str);
+    free(json_str);
+}
+
+/**
+ * @brief Direct handler for GET /api/system/device-profile
+ */
+void mg_handle_get_device_profile(struct mg_connection *c, struct mg_http_message *hm) {
+    log_debug("Handling GET /api/system/device-profile request");
+
+    const device_profile_t *profile = device_profile_get();
+
+    cJSON *response = cJSON_CreateObject();
+    if (!response) {
+        log_error("Failed to create device profile JSON object");
+        mg_send_json_error(c, 500, "Failed to create device profile JSON");
+        return;
+    }
+
+    cJSON_AddStringToObject(response, "tier", device_tier_name(profile->tier));
+    cJSON_AddBoolToObject(response, "tier_configured", profile->tier_configured);
+    cJSON_AddNumberToObject(response, "memory_bytes", (double)profile->memory_bytes);
+    cJSON_AddNumberToObject(response, "cores", profile->cores);
+    cJSON_AddStringToObject(response, "simd", profile->simd);
+
+    cJSON *settings = cJSON_AddObjectToObject(response, "settings");
+    for (int i = 0; settings && i < DEVICE_KNOB_COUNT; i++) {
+        const device_knob_value_t *knob = &profile->knobs[i];
+        cJSON *item = cJSON_AddObjectToObject(settings, knob->name);
+        if (!item) {
+            break;
+        }
+        cJSON_AddNumberToObject(item, "value", knob->value);
+        cJSON_AddNumberToObject(item, "profile", knob->profile_value);
+        cJSON_AddStringToObject(item, "source", knob->configured ? "config" : "profile");
+    }
+
+    char *json_str = cJSON_PrintUnformatted(response);
+    cJSON_Delete(response);
+    if (!json_str) {
+        log_error("Failed to convert device profile JSON to string");
+        mg_send_json_error(c, 500, "Failed to convert device profile JSON to string");
+        return;
+    }
+
+    mg_send_json_response(c, 200, json_str);
+    free(json_str);
+}
+
+/**
+ * @brief Direct handler for GET /api/system/startup
+ */
+void mg_handle_get_stream_startup(struct mg_connection *c, struct mg_http_message *hm) {
+    log_debug("Handling GET /api/system/startup request");
+
+    int max_count = g_config.max_streams > 0 ? g_config.max_streams : 1;
+    stream_startup_status_t *streams = calloc(max_count, sizeof(stream_startup_status_t));
+    if (!streams) {
+        log_error("Failed to allocate stream startup status");
+        mg_send_json_error(c, 500, "Failed to allocate stream startup status");
+        return;
+    }
+
+    bool complete = false;
+    int count = stream_startup_get_status(streams, max_count, &complete);
+
+    cJSON *response = cJSON_CreateObject();
+    if (!response) {
+        free(streams);
+        log_error("Failed to create stream startup JSON object");
+        mg_send_json_error(c, 500, "Failed to create stream startup JSON");
+        return;
+    }
+
+    cJSON_AddNumberToObject(response, "concurrency", stream_startup_concurrency());
+    cJSON_AddBoolToObject(response, "complete", complete);
+
+    int ready = 0;
+    cJSON *streams_array = cJSON_AddArrayToObject(response, "streams");
+    for (int i = 0; i < count; i++) {
+        if (streams[i].state == STREAM_STARTUP_READY) {
+            ready++;
+        }
+        cJSON *stream = streams_array ? cJSON_CreateObject() : NULL;
+        if (!stream) {
+            continue;
+        }
+        cJSON_AddStringToObject(stream, "name", streams[i].name);
+        cJSON_AddStringToObject(stream, "state", stream_startup_state_name(streams[i].state));
+        cJSON_AddNumberToObject(stream, "started_at", (double)streams[i].started_at);
+        cJSON_AddNumberToObject(stream, "ready_at", (double)streams[i].ready_at);
+        cJSON_AddItemToArray(streams_array, stream);
+    }
+    cJSON_AddNumberToObject(response, "ready", ready);
+    cJSON_AddNumberToObject(response, "total", count);
+    free(streams);
+
+    char *json_str = cJSON_PrintUnformatted(response);
+    cJSON_Delete(response);
+    if (!json_str) {
+        log_error("Failed to convert stream startup JSON to string");
+        mg_send_json_error(c, 500, "Failed to convert stream startup JSON to string");
+        return;
+    }
+
+    mg_send_json_response(c, 200, json_str);
+    free(json_str);
+}
+
+/**
+ * @brief Direct handler for GET /api/system/database/integrity
+ *
+ * Progress and result of the background integrity check started after the
+ * fast startup check.
+ */
+void mg_handle_get_database_integrity(struct mg_connection *c, struct mg_http_message *hm) {
+    log_debug("Handling GET /api/system/database/integrity request");
+
+    db_integrity_status_t status;
+    get_integrity_status(&status);
+
+    cJSON *response = cJSON_CreateObject();
+    if (!response) {
+        log_error("Failed to create database integrity JSON object");
+        mg_send_json_error(c, 500, "Failed to create database integrity JSON");
+        return;
+    }
+
+    cJSON_AddStringToObject(response, "state", integrity_state_name(status.state));
+    cJSON_AddNumberToObject(response, "started_at", (double)status.started_at);
+    cJSON_AddNumberToObject(response, "finished_at", (double)status.finished_at);
+    cJSON_AddNumberToObject(response, "tables_checked", status.tables_checked);
+    cJSON_AddNumberToObject(response, "tables_total", status.tables_total);
+    cJSON_AddNumberToObject(response, "errors", status.errors);
+    cJSON_AddBoolToObject(response, "repair_attempted", status.repair_attempted);
+    cJSON_AddBoolToObject(response, "repaired", status.repaired);
+    cJSON_AddStringToObject(response, "message", status.message);
+
+    char *json_str = cJSON_PrintUnformatted(response);
+    cJSON_Delete(response);
+    if (!json_str) {
+        log_error("Failed to convert database integrity JSON to string");
+        mg_send_json_error(c, 500, "Failed to convert database integrity JSON to string");
+        return;
+    }
+
+    mg_send_json_response(c, 200, json_str);
+    free(json_str);
+}
+
+// Send the status of the background database backup
+static void send_backup_status(struct mg_connection *c, int status_code) {
+    db_backup_status_t status;
+    get_backup_status(&status);
+
+    cJSON *response = cJSON_CreateObject();
+    if (!response) {
+        log_error("Failed to create database backup JSON object");
+        mg_send_json_error(c, 500, "Failed to create database backup JSON");
+        return;
+    }
+
+    cJSON_AddStringToObject(response, "state", backup_state_name(status.state));
+    cJSON_AddNumberToObject(response, "started_at", (double)status.started_at);
+    cJSON_AddNumberToObject(response, "finished_at", (double)status.finished_at);
+    cJSON_AddNumberToObject(response, "pages_done", status.pages_done);
+    cJSON_AddNumberToObject(response, "pages_total", status.pages_total);
+    cJSON_AddBoolToObject(response, "compressed", status.compressed);
+    cJSON_AddNumberToObject(response, "size", (double)status.size);
+    cJSON_AddStringToObject(response, "path", status.path);
+    cJSON_AddStringToObject(response, "message", status.message);
+
+    char *json_str = cJSON_PrintUnformatted(response);
+    cJSON_Delete(response);
+    if (!json_str) {
+        log_error("Failed to convert database backup JSON to string");
+        mg_send_json_error(c, 500, "Failed to convert database backup JSON to string");
+        return;
+    }
+
+    mg_send_json_response(c, status_code, json_str);
+    free(json_str);
+}
+
+/**
+ * @brief Direct handler for POST /api/system/database/backup
+ *
+ * Starts a background backup of the database to <db_path>.backup, or
+ * <db_path>.backup.gz with {"compress": true}, replacing the previous one
+ * once complete. Progress is published to the "system/backup" WebSocket
+ * topic.
+ */
+void mg_handle_post_database_backup(struct mg_connection *c, struct mg_http_message *hm) {
+    log_info("Handling POST /api/system/database/backup request");
+
+    bool compress = false;
+    cJSON *body = hm->body.len > 0 ? mg_parse_json_body(hm) : NULL;
+    if (body) {
+        cJSON *compress_json = cJSON_GetObjectItem(body, "compress");
+        compress = compress_json && cJSON_IsTrue(compress_json);
+        cJSON_Delete(body);
+    }
+
+    char dest_path[512];
+    if (snprintf(dest_path, sizeof(dest_path), "%s.backup", g_config.db_path) >= (int)sizeof(dest_path)) {
+        mg_send_json_error(c, 500, "Database path too long");
+        return;
+    }
+
+    int rc = start_database_backup(g_config.db_path, dest_path, compress);
+    if (rc > 0) {
+        mg_send_json_error(c, 409, "A database backup is already running");
+        return;
+    }
+    if (rc < 0) {
+        mg_send_json_error(c, 500, "Failed to start database backup");
+        return;
+    }
+
+    send_backup_status(c, 202);
+}
+
+/**
+ * @brief Direct handler for GET /api/system/database/backup
+ */
+void mg_handle_get_database_backup(struct mg_connection *c, struct mg_http_message *hm) {
+    log_debug("Handling GET /api/system/database/backup request");
+    send_backup_status(c, 200);
+}
+
+/**
+ * @brief Direct handler for GET /api/system/memory
+ *
+ * Tracked memory per subsystem next to the resident size of the process;
+ * the difference is memory no subsystem accounts for (FFmpeg internals,
+ * thread stacks, libraries).
+ */
+void mg_handle_get_memory_usage(struct mg_connection *c, struct mg_http_message *hm) {
+    log_debug("Handling GET /api/system/memory request");
+
+    memory_usage_t usage[MEMORY_TAG_COUNT];
+    memory_get_usage(usage);
+
+    system_stats_t stats;
+    system_stats_get(&stats);
+
+    cJSON *response = cJSON_CreateObject();
+    if (!response) {
+        log_error("Failed to create memory usage JSON object");
+        mg_send_json_error(c, 500, "Failed to create memory usage JSON");
+        return;
+    }
+
+    size_t tracked = 0;
+    cJSON *subsystems = cJSON_AddArrayToObject(response, "subsystems");
+    for (int tag = 0; tag < MEMORY_TAG_COUNT; tag++) {
+        tracked += usage[tag].current;
+        cJSON *subsystem = subsystems ? cJSON_CreateObject() : NULL;
+        if (!subsystem) {
+            continue;
+        }
+        cJSON_AddStringToObject(subsystem, "name", memory_tag_name((memory_tag_t)tag));
+        cJSON_AddNumberToObject(subsystem, "current", (double)usage[tag].current);
+        cJSON_AddNumberToObject(subsystem, "peak", (double)usage[tag].peak);
+        cJSON_AddItemToArray(subsystems, subsystem);
+    }
+
+    size_t budget = memory_get_budget();
+    cJSON_AddNumberToObject(response, "tracked", (double)tracked);
+    cJSON_AddNumberToObject(response, "tracked_peak", (double)get_peak_memory_allocated());
+    cJSON_AddNumberToObject(response, "process", (double)stats.process_memory);
+    cJSON_AddNumberToObject(response, "budget", (double)budget);
+    cJSON_AddBoolToObject(response, "over_budget", budget > 0 && tracked > budget);
+
+    char *json_str = cJSON_PrintUnformatted(response);
+    cJSON_Delete(response);
+    if (!json_str) {
+        log_error("Failed to convert memory usage JSON to string");
+        mg_send_json_error(c, 500, "Failed to convert memory usage JSON to string");
+        return;
+    }
+
+    mg_send_json_response(c, 200, json_str);
+    free(json_str);
+}
+
+// Most threads listed by GET /api/system/threads
+#define MAX_REPORTED_THREADS 512
+
+/**
+ * @brief Direct handler for GET /api/system/threads
+ *
+ * CPU time of every thread of the process, busiest first. cpu_percent
+ * covers the time since the previous request and is -1 on the first one.
+ */
+void mg_handle_get_thread_usage(struct mg_connection *c, struct mg_http_message *hm) {
+    log_debug("Handling GET /api/system/threads request");
+
+    thread_cpu_usage_t *threads = calloc(MAX_REPORTED_THREADS, sizeof(thread_cpu_usage_t));
+    if (!threads) {
+        mg_send_json_error(c, 500, "Failed to allocate thread list");
+        return;
+    }
+
+    int count = thread_get_cpu_usage(threads, MAX_REPORTED_THREADS);
+    if (count < 0) {
+        free(threads);
+        mg_send_json_error(c, 500, "Failed to read thread statistics");
+        return;
+    }
+
+    cJSON *response = cJSON_CreateObject();
+    if (!response) {
+        free(threads);
+        log_error("Failed to create thread usage JSON object");
+        mg_send_json_error(c, 500, "Failed to create thread usage JSON");
+        return;
+    }
+
+    cJSON_AddNumberToObject(response, "cpus", (double)sysconf(_SC_NPROCESSORS_ONLN));
+    cJSON_AddNumberToObject(response, "count", count);
+    cJSON *list = cJSON_AddArrayToObject(response, "threads");
+    for (int i = 0; i < count && list; i++) {
+        cJSON *thread = cJSON_CreateObject();
+        if (!thread) {
+            continue;
+        }
+        cJSON_AddNumberToObject(thread, "tid", threads[i].tid);
+        cJSON_AddStringToObject(thread, "name", threads[i].name);
+        cJSON_AddNumberToObject(thread, "user_seconds", threads[i].user_seconds);
+        cJSON_AddNumberToObject(thread, "system_seconds", threads[i].system_seconds);
+        cJSON_AddNumberToObject(thread, "cpu_percent", threads[i].cpu_percent);
+        cJSON_AddNumberToObject(thread, "nice", threads[i].nice);
+        cJSON_AddNumberToObject(thread, "cpu", threads[i].last_cpu);
+        cJSON_AddItemToArray(list, thread);
+    }
+    free(threads);
+
+    char *json_str = cJSON_PrintUnformatted(response);
+    cJSON_Delete(response);
+    if (!json_str) {
+        log_error("Failed to convert thread usage JSON to string");
+        mg_send_json_error(c, 500, "Failed to convert thread usage JSON to string");
+        return;
+    }
+
+    mg_send_json_response(c, 200, json_str);
+    free(json_str);
+}
@@ -205,6 +205,67 @@ int log_level_meets_minimum(const char *log_level, const char *min_level) {
     return level_value <= min_value;
 }
 
+/**
+ * @brief Map a minimum level name to the logger's level
+ */
+static log_level_t log_level_from_name(const char *name) {
+    if (strcmp(name, "error") == 0) {
+        return LOG_LEVEL_ERROR;
+    } else if (strcmp(name, "warning") == 0 || strcmp(name, "warn") == 0) {
+        return LOG_LEVEL_WARN;
+    } else if (strcmp(name, "debug") == 0) {
+        return LOG_LEVEL_DEBUG;
+    }
+    return LOG_LEVEL_INFO;
+}
+
+/**
+ * @brief Build a JSON array of the newest log entries kept in memory
+ */
+cJSON *get_recent_logs_json(const char *min_level, uint64_t after_seq, const char *last_timestamp,
+                            int max_count, uint64_t *latest_seq, int *count) {
+    static const char *level_names[] = {"error", "warning", "info", "debug"};
+
+    *count = 0;
+    if (max_count <= 0 || max_count > LOG_RING_SIZE) {
+        max_count = LOG_RING_SIZE;
+    }
+
+    log_entry_t *entries = malloc(sizeof(log_entry_t) * max_count);
+    if (!entries) {
+        log_error("Failed to allocate memory for log entries");
+        return NULL;
+    }
+
+    int n = get_recent_logs(after_seq, log_level_from_name(min_level), entries, max_count, latest_seq);
+
+    cJSON *logs_array = cJSON_CreateArray();
+    if (!logs_array) {
+        free(entries);
+        return NULL;
+    }
+
+    for (int i = 0; i < n; i++) {
+        // Clients that only know timestamps resume after the last one they saw
+        if (last_timestamp && last_timestamp[0] && strcmp(entries[i].timestamp, last_timestamp) <= 0) {
+            continue;
+        }
+
+        cJSON *log_entry = cJSON_CreateObject();
+        if (log_entry) {
+            cJSON_AddNumberToObject(log_entry, "seq", (double)entries[i].seq);
+            cJSON_AddStringToObject(log_entry, "timestamp", entries[i].timestamp);
+            cJSON_AddStringToObject(log_entry, "level", level_names[entries[i].level]);
+            cJSON_AddStringToObject(log_entry, "message", entries[i].message);
+            cJSON_AddItemToArray(logs_array, log_entry);
+            (*count)++;
+        }
+    }
+
+    free(entries);
+    return logs_array;
+}
+
 /**
  * @brief Direct handler for GET /api/system/logs
  */
@@ -223,13 +284,18 @@ void mg_handle_get_system_logs(struct mg_connection *c, struct mg_http_message *
         level[sizeof(level) - 1] = '\0';
     }
 
-    // Get system logs
-    char **logs = NULL;
-    int count = 250;
-
-    const int result = get_json_logs_tail(level, NULL, &logs, &count);
+    // Extract the sequence number to resume after
+    uint64_t since = 0;
+    char since_buf[24] = {0};
+    if (mg_http_get_var(&query, "since", since_buf, sizeof(since_buf)) > 0) {
+        since = strtoull(since_buf, NULL, 10);
+    }
 
-    if (result != 0 || !logs) {
+    // Get system logs from memory
+    uint64_t latest_seq = 0;
+    int count = 0;
+    cJSON *logs_array = get_recent_logs_json(level, since, NULL, 500, &latest_seq, &count);
+    if (!logs_array) {
         mg_send_json_error(c, 500, "Failed to get system logs");
         return;
     }
@@ -238,161 +304,21 @@ void mg_handle_get_system_logs(struct mg_connection *c, struct mg_http_message *
     cJSON *logs_obj = cJSON_CreateObject();
     if (!logs_obj) {
         log_error("Failed to create logs JSON object");
-
-        // Free logs
-        if (logs) {
-            for (int i = 0; i < count; i++) {
-                if (logs[i]) {
-                    free(logs[i]);
-                }
-            }
-            free(logs);
-        }
-
+        cJSON_Delete(logs_array);
         mg_send_json_error(c, 500, "Failed to create logs JSON");
         return;
     }
 
-    // Create logs array
-    cJSON *logs_array = cJSON_CreateArray();
-    if (!logs_array) {
-        log_error("Failed to create logs array");
-
-        // Free logs
-        if (logs) {
-            for (int i = 0; i < count; i++) {
-                if (logs[i]) {
-                    free(logs[i]);
-                }
-            }
-            free(logs);
-        }
-
-        cJSON_Delete(logs_obj);
-        mg_send_json_error(c, 500, "Failed to create logs array");
-        return;
-    }
-
-    // Parse and add logs to array as objects (similar to WebSocket implementation)
-    for (int i = 0; i < count; i++) {
-        if (logs[i] != NULL) {
-            // Parse log line (format: [TIMESTAMP] [LEVEL] MESSAGE)
-            char timestamp[32] = "Unknown";
-            char log_level[16] = "info";
-            char *message = logs[i];
-
-            // First, check if this is a standard format log
-            if (logs[i][0] == '[') {
-                char *timestamp_end = strchr(logs[i] + 1, ']');
-                if (timestamp_end) {
-                    size_t timestamp_len = timestamp_end - (logs[i] + 1);
-                    if (timestamp_len < sizeof(timestamp)) {
-                        memcpy(timestamp, logs[i] + 1, timestamp_len);
-                        timestamp[timestamp_len] = '\0';
-
-                        // Look for level
-                        char *level_start = strchr(timestamp_end + 1, '[');
-                        if (level_start) {
-                            char *level_end = strchr(level_start + 1, ']');
-                            if (level_end) {
-                                size_t level_len = level_end - (level_start + 1);
-                                if (level_len < sizeof(log_level)) {
-                                    memcpy(log_level, level_start + 1, level_len);
-                                    log_level[level_len] = '\0';
-
-                                    // Convert to lowercase for consistency
-                                    for (int j = 0; log_level[j]; j++) {
-                                        log_level[j] = tolower(log_level[j]);
-                                    }
-
-                                    // Message starts after level
-                                    message = level_end + 1;
-                                    if (message && *message) {
-                                        while (*message == ' ') message++; // Skip leading spaces
-                                    } else {
-                                        message = ""; // Set to empty string if NULL or empty
-                                    }
-                                }
-                            }
-                        }
-                    }
-                }
-            }
-            // Check for alternative format: TIMESTAMP LEVEL MESSAGE
-            else if (isdigit(logs[i][0])) {
-                // Try to parse YYYY-MM-DD HH:MM:SS format
-                if (strlen(logs[i]) > 19 && logs[i][4] == '-' && logs[i][7] == '-' && logs[i][10] == ' ' && logs[i][13] == ':' && logs[i][16] == ':') {
-                    strncpy(timestamp, logs[i], 19);
-                    timestamp[19] = '\0';
-
-                    // Extract level - assume it follows timestamp immediately
-                    char *level_start = logs[i] + 19;
-                    while (*level_start == ' ') level_start++; // Skip spaces
-
-                    // Find end of level (next space)
-                    char *level_end = strchr(level_start, ' ');
-                    if (level_end) {
-                        size_t level_len = level_end - level_start;
-                        if (level_len < sizeof(log_level)) {
-                            memcpy(log_level, level_start, level_len);
-                            log_level[level_len] = '\0';
-
-                            // Convert to lowercase for consistency
-                            for (int j = 0; log_level[j]; j++) {
-                                log_level[j] = tolower(log_level[j]);
-                            }
-
-                            // Message starts after level
-                            message = level_end + 1;
-                            if (message && *message) {
-                                while (*message == ' ') message++; // Skip leading spaces
-                            } else {
-                                message = ""; // Set to empty string if NULL or empty
-                            }
-                        }
-                    }
-                }
-            }
-
-            // Normalize log level
-            if (strcmp(log_level, "warn") == 0) {
-                strcpy(log_level, "warning");
-            }
-
-            // Check if this log meets the minimum level
-            if (log_level_meets_minimum(log_level, level)) {
-                // Create log entry object
-                cJSON *log_entry = cJSON_CreateObject();
-                if (log_entry) {
-                    cJSON_AddStringToObject(log_entry, "timestamp", timestamp);
-                    cJSON_AddStringToObject(log_entry, "level", log_level);
-                    cJSON_AddStringToObject(log_entry, "message", message);
-
-                    cJSON_AddItemToArray(logs_array, log_entry);
-                }
-            }
-        }
-    }
-
     // Add logs array to response
     cJSON_AddItemToObject(logs_obj, "logs", logs_array);
 
     // Add metadata
     cJSON_AddStringToObject(logs_obj, "file", g_config.log_file);
     cJSON_AddStringToObject(logs_obj, "level", level);
+    cJSON_AddNumberToObject(logs_obj, "latest_seq", (double)latest_seq);
 
     // Convert to string
     char *json_str = cJSON_PrintUnformatted(logs_obj);
-
-    // Clean up
-    if (logs) {
-        for (int i = 0; i < count; i++) {
-            if (logs[i]) {
-                free(logs[i]);
-            }
-        }
-        free(logs);
-    }
     cJSON_Delete(logs_obj);
 
     if (!json_str) {
@@ -446,6 +372,7 @@ void mg_handle_post_system_logs_clear(struct mg_connection *c, struct mg_http_me
     int fd = open(log_file, O_WRONLY | O_TRUNC | O_CREAT, 0644);
     if (fd >= 0) {
         close(fd);
+        clear_recent_logs();
         log_info("Log file cleared via API: %s", log_file);
 
         // Create success response using cJSON
@@ -208,8 +208,8 @@ void websocket_handle_system_logs(const char *client_id, const char *message) {
 
         log_info("Client %s subscribed to system logs with level: %s", client_id, log_level);
 
-        // Fetch logs using the optimized approach
-        fetch_system_logs(client_id, log_level, NULL);
+        // Send the logs kept in memory
+        fetch_system_logs(client_id, log_level, NULL, 0);
     }
     // Handle unsubscribe message
     else if (strcmp(type, "unsubscribe") == 0) {
@@ -244,22 +244,30 @@ void websocket_handle_system_logs(const char *client_id, const char *message) {
 
         // If we didn't find params or timestamp in params, check the payload object directly
         // This handles the case where the frontend sends the timestamp in the payload directly
-        if (!last_timestamp) {
-            // Check if payload_obj is the same as json (for direct payload)
-            if (payload_obj == json) {
-                cJSON *timestamp_obj = cJSON_GetObjectItem(payload_obj, "last_timestamp");
-                if (timestamp_obj && cJSON_IsString(timestamp_obj)) {
-                    last_timestamp = timestamp_obj->valuestring;
-                    log_debug("Found last_timestamp in direct payload: %s", last_timestamp);
-                }
+        if (!last_timestamp && payload_obj) {
+            cJSON *timestamp_obj = cJSON_GetObjectItem(payload_obj, "last_timestamp");
+            if (timestamp_obj && cJSON_IsString(timestamp_obj)) {
+                last_timestamp = timestamp_obj->valuestring;
+                log_debug("Found last_timestamp in payload: %s", last_timestamp);
             }
         }
 
-        log_info("Client %s fetching logs with level: %s, last_timestamp: %s",
-                client_id, log_level, last_timestamp ? last_timestamp : "NULL");
+        // Clients that know sequence numbers resume exactly where they left off
+        uint64_t last_seq = 0;
+        cJSON *seq_obj = params_obj ? cJSON_GetObjectItem(params_obj, "last_seq") : NULL;
+        if (!seq_obj && payload_obj) {
+            seq_obj = cJSON_GetObjectItem(payload_obj, "last_seq");
+        }
+        if (seq_obj && cJSON_IsNumber(seq_obj) && seq_obj->valuedouble > 0) {
+            last_seq = (uint64_t)seq_obj->valuedouble;
+        }
+
+        log_debug("Client %s fetching logs with level: %s, last_timestamp: %s, last_seq: %llu",
+                client_id, log_level, last_timestamp ? last_timestamp : "NULL",
+                (unsigned long long)last_seq);
 
-        // Fetch logs using the optimized approach
-        fetch_system_logs(client_id, log_level, last_timestamp);
+        // Fetch logs from memory
+        fetch_system_logs(client_id, log_level, last_timestamp, last_seq);
     }
     // Handle unknown message type
     else {
@@ -284,241 +292,36 @@ void websocket_handle_system_logs(const char *client_id, const char *message) {
 }
 
 /**
- * @brief Send system logs to a specific client with filtering
- *
- * @param client_id The client ID to send logs to
- * @param min_level The minimum log level to include
- * @return int 1 if logs were sent, 0 otherwise
- */
-static int send_filtered_logs_to_client(const char *client_id, const char *min_level) {
-    log_info("send_filtered_logs_to_client called for client %s with level %s", client_id, min_level);
-
-    char **logs = NULL;
-    int count = 0;
-
-    // Use the optimized tail-based log retrieval
-    // Request 1000 lines to ensure we have enough after filtering
-    int result = get_system_logs_tail(&logs, &count, 1000);
-
-    if (result != 0 || logs == NULL || count == 0) {
-        return 0;
-    }
-
-    log_info("Processing %d logs from tail", count);
-
-    // Create JSON array of logs
-    cJSON *logs_array = cJSON_CreateArray();
-
-    for (int i = 0; i < count; i++) {
-        if (logs[i] != NULL) {
-            // Parse log line (format: [TIMESTAMP] [LEVEL] MESSAGE)
-            // Use smaller buffers to reduce stack usage
-            char timestamp[24] = "";
-            char log_level[12] = "";
-            char *message = NULL;
-
-            // First, check if this is a standard format log
-            if (logs[i][0] == '[') {
-                char *timestamp_end = strchr(logs[i] + 1, ']');
-                if (timestamp_end) {
-                    size_t timestamp_len = timestamp_end - (logs[i] + 1);
-                    if (timestamp_len < sizeof(timestamp)) {
-                        memcpy(timestamp, logs[i] + 1, timestamp_len);
-                        timestamp[timestamp_len] = '\0';
-
-                        // Look for level
-                        char *level_start = strchr(timestamp_end + 1, '[');
-                        if (level_start) {
-                            char *level_end = strchr(level_start + 1, ']');
-                            if (level_end) {
-                                size_t level_len = level_end - (level_start + 1);
-                                if (level_len < sizeof(log_level)) {
-                                    memcpy(log_level, level_start + 1, level_len);
-                                    log_level[level_len] = '\0';
-
-                                    // Convert to lowercase for consistency
-                                    for (int j = 0; log_level[j]; j++) {
-                                        log_level[j] = tolower(log_level[j]);
-                                    }
-
-                                    // Message starts after level
-                                    message = level_end + 1;
-                                    if (message && *message) {
-                                        while (*message == ' ') message++; // Skip leading spaces
-                                    } else {
-                                        message = ""; // Set to empty string if NULL or empty
-                                    }
-                                }
-                            }
-                        }
-                    }
-                }
-            }
-            // Check for alternative format: TIMESTAMP LEVEL MESSAGE
-            else if (isdigit(logs[i][0])) {
-                // Try to parse YYYY-MM-DD HH:MM:SS format
-                if (strlen(logs[i]) > 19 && logs[i][4] == '-' && logs[i][7] == '-' && logs[i][10] == ' ' && logs[i][13] == ':' && logs[i][16] == ':') {
-                    strncpy(timestamp, logs[i], 19);
-                    timestamp[19] = '\0';
-
-                    // Extract level - assume it follows timestamp immediately
-                    char *level_start = logs[i] + 19;
-                    while (*level_start == ' ') level_start++; // Skip spaces
-
-                    // Find end of level (next space)
-                    char *level_end = strchr(level_start, ' ');
-                    if (level_end) {
-                        size_t level_len = level_end - level_start;
-                        if (level_len < sizeof(log_level)) {
-                            memcpy(log_level, level_start, level_len);
-                            log_level[level_len] = '\0';
-
-                            // Convert to lowercase for consistency
-                            for (int j = 0; log_level[j]; j++) {
-                                log_level[j] = tolower(log_level[j]);
-                            }
-
-                            // Message starts after level
-                            message = level_end + 1;
-                            if (message && *message) {
-                                while (*message == ' ') message++; // Skip leading spaces
-                            } else {
-                                message = ""; // Set to empty string if NULL or empty
-                            }
-                        }
-                    }
-                }
-            }
-
-            // If parsing failed, use defaults
-            if (!message) {
-                message = logs[i];
-
-                // Check if the message starts with "Unknown"
-                if (strncmp(message, "Unknown", 7) == 0) {
-                    strcpy(log_level, "info");
-
-                    // Skip "Unknown" prefix in the message
-                    if (strlen(message) > 7) {
-                        message += 7;
-                        while (*message == ' ') message++; // Skip spaces
-                    }
-                } else {
-                    strcpy(log_level, "info");
-                }
-            }
-
-            // Normalize log level
-            if (strcmp(log_level, "warn") == 0) {
-                strcpy(log_level, "warning");
-            }
-
-            // Only include logs that meet the minimum level
-            if (log_level_meets_minimum(log_level, min_level)) {
-                // Create log entry object
-                cJSON *log_entry = cJSON_CreateObject();
-                if (log_entry) {
-                    cJSON_AddStringToObject(log_entry, "timestamp", timestamp[0] ? timestamp : "Unknown");
-                    cJSON_AddStringToObject(log_entry, "level", log_level);
-                    cJSON_AddStringToObject(log_entry, "message", message);
-
-                    cJSON_AddItemToArray(logs_array, log_entry);
-                }
-            }
-        }
-    }
-
-    // Create JSON payload
-    cJSON *payload = cJSON_CreateObject();
-    cJSON_AddItemToObject(payload, "logs", logs_array);
-    // Include level at the top level for frontend filtering purposes
-    cJSON_AddStringToObject(payload, "level", min_level);
-
-    // Convert payload to string
-    char *payload_str = cJSON_PrintUnformatted(payload);
-
-    // Create WebSocket message
-    char *logs_message = NULL;
-    int len = asprintf(&logs_message, "{\"type\":\"update\",\"topic\":\"system/logs\",\"payload\":%s}", payload_str);
-
-    result = 0;
-
-    if (len > 0 && logs_message != NULL) {
-        // Get client connection directly from pointer value stored in client_id string
-        struct mg_connection *conn = NULL;
-        if (sscanf(client_id, "%p", &conn) == 1 && conn) {
-            // Send message directly using mongoose
-            mg_ws_send(conn, logs_message, strlen(logs_message), WEBSOCKET_OP_TEXT);
-            result = 1;
-        } else {
-            log_error("Invalid client ID or connection not found: %s", client_id);
-        }
-
-        // Free the message
-        free(logs_message);
-    }
-
-    cJSON_Delete(payload);
-    free(payload_str);
-
-    // Free logs
-    if (logs) {
-        for (int i = 0; i < count; i++) {
-            if (logs[i]) {
-                free(logs[i]);
-            }
-        }
-        free(logs);
-    }
-
-    return result;
-}
-
-/**
- * @brief Fetch system logs with timestamp-based pagination
+ * @brief Fetch system logs from memory
  *
  * @param client_id WebSocket client ID
  * @param min_level Minimum log level to include
  * @param last_timestamp Last timestamp received by client (for pagination)
+ * @param last_seq Last sequence number received by client (0 for none)
  * @return int Number of logs sent
  */
-int fetch_system_logs(const char *client_id, const char *min_level, const char *last_timestamp) {
-    log_info("fetch_system_logs called for client %s with level %s, last_timestamp %s",
-             client_id, min_level, last_timestamp ? last_timestamp : "NULL");
-
-    // Get logs using the optimized tail-based approach if available
-    char **logs = NULL;
-    int count = 250;
-
-    // Try to use the optimized tail-based JSON logs function first
-    const int result = get_json_logs_tail(min_level, last_timestamp, &logs, &count);
-    if (result != 0 || logs == NULL || count == 0) {
-        log_error("Failed to get JSON logs using tail command");
+int fetch_system_logs(const char *client_id, const char *min_level, const char *last_timestamp,
+                      uint64_t last_seq) {
+    log_debug("fetch_system_logs called for client %s with level %s, last_seq %llu",
+             client_id, min_level, (unsigned long long)last_seq);
+
+    // The sequence number is exact; the timestamp is only used without one
+    uint64_t latest_seq = 0;
+    int count = 0;
+    cJSON *logs_array = get_recent_logs_json(min_level, last_seq, last_seq ? NULL : last_timestamp,
+                                             250, &latest_seq, &count);
+    if (!logs_array) {
+        log_error("Failed to get system logs");
         return 0;
     }
 
-    // Create JSON array of logs
-    cJSON *logs_array = cJSON_CreateArray();
-
     // Track the latest timestamp for pagination
-    char latest_timestamp[32] = "";
-
-    // Process each log entry (already in JSON format)
-    for (int i = 0; i < count; i++) {
-        if (logs[i] != NULL) {
-            // Parse JSON log entry
-            cJSON *log_entry = cJSON_Parse(logs[i]);
-            if (log_entry) {
-                // Add to logs array
-                cJSON_AddItemToArray(logs_array, log_entry);
-
-                // Update latest timestamp for pagination
-                cJSON *timestamp = cJSON_GetObjectItem(log_entry, "timestamp");
-                if (timestamp && cJSON_IsString(timestamp) && timestamp->valuestring) {
-                    strncpy(latest_timestamp, timestamp->valuestring, sizeof(latest_timestamp) - 1);
-                    latest_timestamp[sizeof(latest_timestamp) - 1] = '\0';
-                }
-            }
+    const char *latest_timestamp = NULL;
+    cJSON *last_entry = count > 0 ? cJSON_GetArrayItem(logs_array, count - 1) : NULL;
+    if (last_entry) {
+        cJSON *timestamp = cJSON_GetObjectItem(last_entry, "timestamp");
+        if (timestamp && cJSON_IsString(timestamp)) {
+            latest_timestamp = timestamp->valuestring;
         }
     }
 
@@ -527,19 +330,25 @@ int fetch_system_logs(const char *client_id, const char *min_level, const char *
     cJSON_AddItemToObject(payload, "logs", logs_array);
     // Include level at the top level for frontend filtering purposes
     cJSON_AddStringToObject(payload, "level", min_level);
-    // Include latest timestamp for pagination
-    if (latest_timestamp[0] != '\0') {
+    // Include latest timestamp and sequence number for pagination
+    if (latest_timestamp) {
         cJSON_AddStringToObject(payload, "latest_timestamp", latest_timestamp);
     }
+    cJSON_AddNumberToObject(payload, "latest_seq", (double)latest_seq);
     // Indicate if there might be more logs
-    cJSON_AddBoolToObject(payload, "more", count >= 50); // Assume more if we hit the limit
+    cJSON_AddBoolToObject(payload, "more", count >= 250);
 
     // Convert payload to string
     char *payload_str = cJSON_PrintUnformatted(payload);
+    cJSON_Delete(payload);
+    if (!payload_str) {
+        return 0;
+    }
 
     // Create WebSocket message
     char *logs_message = NULL;
     int len = asprintf(&logs_message, "{\"type\":\"update\",\"topic\":\"system/logs\",\"payload\":%s}", payload_str);
+    free(payload_str);
 
     int sent = 0;
 
@@ -548,7 +357,7 @@ int fetch_system_logs(const char *client_id, const char *min_level, const char *
         struct mg_connection *conn = NULL;
         if (sscanf(client_id, "%p", &conn) == 1 && conn) {
             // Send message directly using mongoose
-            mg_ws_send(conn, logs_message, strlen(logs_message), WEBSOCKET_OP_TEXT);
+            mg_ws_send(conn, logs_message, (size_t)len, WEBSOCKET_OP_TEXT);
             sent = count;
         } else {
             log_error("Invalid client ID or connection not found: %s", client_id);
@@ -558,18 +367,5 @@ int fetch_system_logs(const char *client_id, const char *min_level, const char *
         free(logs_message);
     }
 
-    cJSON_Delete(payload);
-    free(payload_str);
-
-    // Free logs
-    if (logs) {
-        for (int i = 0; i < count; i++) {
-            if (logs[i]) {
-                free(logs[i]);
-            }
-        }
-        free(logs);
-    }
-
-    return sent ? count : 0;
+    return sent;
 }
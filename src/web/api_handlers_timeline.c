@@ -14,25 +14,59 @@
 #include "web/api_handlers_timeline.h"
 #include "web/api_handlers.h"
 #include "web/mongoose_adapter.h"
+#include "web/json_writer.h"
 #include "core/logger.h"
 #include "core/config.h"
 #include "mongoose.h"
 #include "database/database_manager.h"
 #include "database/db_recordings.h"
+#include "database/db_compaction.h"
+#include "database/db_recording_usage.h"
+#include "database/db_detection_activity.h"
+#include "storage/archive_worker.h"
+#include "video/recording_vod.h"
 
 // Forward declarations for Mongoose API handlers
 void mg_handle_get_timeline_segments(struct mg_connection *c, struct mg_http_message *hm);
 void mg_handle_timeline_manifest(struct mg_connection *c, struct mg_http_message *hm);
 void mg_handle_timeline_playback(struct mg_connection *c, struct mg_http_message *hm);
+void mg_handle_get_timeline_activity(struct mg_connection *c, struct mg_http_message *hm);
+void mg_handle_get_timeline_segments_batch(struct mg_connection *c, struct mg_http_message *hm);
 
 // Maximum number of segments to return in a single request
 #define MAX_TIMELINE_SEGMENTS 1000
 
-// Maximum number of segments in a manifest
+// Maximum number of recordings in a manifest
 #define MAX_MANIFEST_SEGMENTS 100
 
-// Mutex for manifest creation
-static pthread_mutex_t manifest_mutex = PTHREAD_MUTEX_INITIALIZER;
+// Buckets of an activity request when it does not give their length
+#define ACTIVITY_DEFAULT_BUCKETS 288
+
+// Most buckets an activity request may ask for
+#define ACTIVITY_MAX_BUCKETS 10000
+
+// Number of (stream, range) timelines kept in memory
+#define TIMELINE_CACHE_ENTRIES 16
+
+// Requested ranges are widened to whole buckets of this many seconds, so
+// repeated requests for about the same range share a cache entry
+#define TIMELINE_CACHE_BUCKET 60
+
+typedef struct {
+    bool used;
+    char stream_name[MAX_STREAM_NAME];
+    time_t start_time;              // Range, widened to whole buckets
+    time_t end_time;
+    uint64_t change_seq;            // Recording changes seen when loaded
+    uint64_t last_used;
+    timeline_segment_t *segments;
+    int count;
+} timeline_cache_entry_t;
+
+static timeline_cache_entry_t timeline_cache[TIMELINE_CACHE_ENTRIES];
+static uint64_t timeline_cache_clock = 0;
+static timeline_segment_t *timeline_scratch = NULL;
+static pthread_mutex_t timeline_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 /**
  * Get timeline segments for a specific stream and time range
@@ -65,7 +99,9 @@ int get_timeline_segments(const char *stream_name, time_t start_time, time_t end
     for (int i = 0; i < count; i++) {
         segments[i].id = recordings[i].id;
         strncpy(segments[i].stream_name, recordings[i].stream_name, sizeof(segments[i].stream_name) - 1);
+        segments[i].stream_name[sizeof(segments[i].stream_name) - 1] = '\0';
         strncpy(segments[i].file_path, recordings[i].file_path, sizeof(segments[i].file_path) - 1);
+        segments[i].file_path[sizeof(segments[i].file_path) - 1] = '\0';
         segments[i].start_time = recordings[i].start_time;
         segments[i].end_time = recordings[i].end_time;
         segments[i].size_bytes = recordings[i].size_bytes;
@@ -78,6 +114,96 @@ int get_timeline_segments(const char *stream_name, time_t start_time, time_t end
     return count;
 }
 
+/**
+ * Get the timeline of a stream, from memory unless a recording within the
+ * range changed since it was loaded
+ * On success the cache stays locked until release_timeline().
+ *
+ * @return Cache entry, or NULL on error
+ */
+static timeline_cache_entry_t *acquire_timeline(const char *stream_name, time_t start_time, time_t end_time) {
+    start_time = start_time / TIMELINE_CACHE_BUCKET * TIMELINE_CACHE_BUCKET;
+    end_time = (end_time + TIMELINE_CACHE_BUCKET - 1) / TIMELINE_CACHE_BUCKET * TIMELINE_CACHE_BUCKET;
+
+    pthread_mutex_lock(&timeline_cache_mutex);
+
+    // Look for the range, noting the least recently used entry on the way
+    timeline_cache_entry_t *entry = NULL;
+    timeline_cache_entry_t *victim = &timeline_cache[0];
+    for (int i = 0; i < TIMELINE_CACHE_ENTRIES; i++) {
+        timeline_cache_entry_t *e = &timeline_cache[i];
+        if (!e->used) {
+            if (victim->used) {
+                victim = e;
+            }
+            continue;
+        }
+        if (e->start_time == start_time && e->end_time == end_time &&
+            strcmp(e->stream_name, stream_name) == 0) {
+            entry = e;
+            break;
+        }
+        if (victim->used && e->last_used < victim->last_used) {
+            victim = e;
+        }
+    }
+
+    if (entry && !recordings_changed_since(entry->change_seq, stream_name, start_time, end_time)) {
+        entry->last_used = ++timeline_cache_clock;
+        return entry;
+    }
+    if (!entry) {
+        entry = victim;
+    }
+
+    if (!timeline_scratch) {
+        timeline_scratch = (timeline_segment_t *)malloc(MAX_TIMELINE_SEGMENTS * sizeof(timeline_segment_t));
+        if (!timeline_scratch) {
+            log_error("Failed to allocate memory for timeline segments");
+            pthread_mutex_unlock(&timeline_cache_mutex);
+            return NULL;
+        }
+    }
+
+    // Taken before the query, so a change made during it is seen next time
+    uint64_t change_seq = get_recording_change_seq();
+    int count = get_timeline_segments(stream_name, start_time, end_time, timeline_scratch, MAX_TIMELINE_SEGMENTS);
+    if (count < 0) {
+        pthread_mutex_unlock(&timeline_cache_mutex);
+        return NULL;
+    }
+
+    if (count > 0) {
+        timeline_segment_t *segments = (timeline_segment_t *)realloc(entry->segments,
+                                                                     count * sizeof(timeline_segment_t));
+        if (!segments) {
+            log_error("Failed to allocate memory for timeline segments");
+            pthread_mutex_unlock(&timeline_cache_mutex);
+            return NULL;
+        }
+        memcpy(segments, timeline_scratch, count * sizeof(timeline_segment_t));
+        entry->segments = segments;
+    }
+
+    entry->used = true;
+    strncpy(entry->stream_name, stream_name, sizeof(entry->stream_name) - 1);
+    entry->stream_name[sizeof(entry->stream_name) - 1] = '\0';
+    entry->start_time = start_time;
+    entry->end_time = end_time;
+    entry->change_seq = change_seq;
+    entry->last_used = ++timeline_cache_clock;
+    entry->count = count;
+
+    return entry;
+}
+
+/**
+ * Unlock the cache after acquire_timeline()
+ */
+static void release_timeline(void) {
+    pthread_mutex_unlock(&timeline_cache_mutex);
+}
+
 /**
  * @brief Handler for GET /api/timeline/segments
  */
@@ -207,86 +333,47 @@ void mg_handle_get_timeline_segments(struct mg_connection *c, struct mg_http_mes
     }
     
     // Get timeline segments
-    timeline_segment_t *segments = (timeline_segment_t *)malloc(MAX_TIMELINE_SEGMENTS * sizeof(timeline_segment_t));
-    if (!segments) {
-        log_error("Failed to allocate memory for timeline segments");
-        mg_send_json_error(c, 500, "Failed to allocate memory for timeline segments");
-        return;
-    }
-    
-    int count = get_timeline_segments(stream_name, start_time, end_time, segments, MAX_TIMELINE_SEGMENTS);
-    
-    if (count < 0) {
+    timeline_cache_entry_t *timeline = acquire_timeline(stream_name, start_time, end_time);
+    if (!timeline) {
         log_error("Failed to get timeline segments");
-        free(segments);
         mg_send_json_error(c, 500, "Failed to get timeline segments");
         return;
     }
-    
-    // Create response object
-    cJSON *response = cJSON_CreateObject();
-    if (!response) {
-        log_error("Failed to create response JSON object");
-        free(segments);
-        mg_send_json_error(c, 500, "Failed to create response JSON");
-        return;
-    }
-    
-    // Create segments array
-    cJSON *segments_array = cJSON_CreateArray();
-    if (!segments_array) {
-        log_error("Failed to create segments JSON array");
-        free(segments);
-        cJSON_Delete(response);
-        mg_send_json_error(c, 500, "Failed to create segments JSON");
-        return;
-    }
-    
-    // Add segments array to response
-    cJSON_AddItemToObject(response, "segments", segments_array);
-    
-    // Add metadata
-    cJSON_AddStringToObject(response, "stream", stream_name);
+    const timeline_segment_t *segments = timeline->segments;
+    int count = timeline->count;
     
     // Format timestamps for display in local time
     char start_time_display[32] = {0};
     char end_time_display[32] = {0};
-    struct tm *tm_info;
+    struct tm tm_buf;
     
-    tm_info = localtime(&start_time);
-    if (tm_info) {
-        strftime(start_time_display, sizeof(start_time_display), "%Y-%m-%d %H:%M:%S", tm_info);
+    if (localtime_r(&start_time, &tm_buf)) {
+        strftime(start_time_display, sizeof(start_time_display), "%Y-%m-%d %H:%M:%S", &tm_buf);
     }
     
-    tm_info = localtime(&end_time);
-    if (tm_info) {
-        strftime(end_time_display, sizeof(end_time_display), "%Y-%m-%d %H:%M:%S", tm_info);
+    if (localtime_r(&end_time, &tm_buf)) {
+        strftime(end_time_display, sizeof(end_time_display), "%Y-%m-%d %H:%M:%S", &tm_buf);
     }
     
-    cJSON_AddStringToObject(response, "start_time", start_time_display);
-    cJSON_AddStringToObject(response, "end_time", end_time_display);
-    cJSON_AddNumberToObject(response, "segment_count", count);
+    // Stream the response straight from the cached segments
+    json_writer_t writer;
+    json_writer_t *w = &writer;
+    json_writer_begin(w, c, 200);
+    json_write_object_start(w, NULL);
+    json_write_array_start(w, "segments");
     
     // Add each segment to the array
     for (int i = 0; i < count; i++) {
-        cJSON *segment = cJSON_CreateObject();
-        if (!segment) {
-            log_error("Failed to create segment JSON object");
-            continue;
-        }
-        
         // Format timestamps in local time
         char segment_start_time[32] = {0};
         char segment_end_time[32] = {0};
         
-        tm_info = localtime(&segments[i].start_time);
-        if (tm_info) {
-            strftime(segment_start_time, sizeof(segment_start_time), "%Y-%m-%d %H:%M:%S", tm_info);
+        if (localtime_r(&segments[i].start_time, &tm_buf)) {
+            strftime(segment_start_time, sizeof(segment_start_time), "%Y-%m-%d %H:%M:%S", &tm_buf);
         }
         
-        tm_info = localtime(&segments[i].end_time);
-        if (tm_info) {
-            strftime(segment_end_time, sizeof(segment_end_time), "%Y-%m-%d %H:%M:%S", tm_info);
+        if (localtime_r(&segments[i].end_time, &tm_buf)) {
+            strftime(segment_end_time, sizeof(segment_end_time), "%Y-%m-%d %H:%M:%S", &tm_buf);
         }
         
         // Calculate duration in seconds
@@ -304,63 +391,301 @@ void mg_handle_get_timeline_segments(struct mg_connection *c, struct mg_http_mes
             snprintf(size_str, sizeof(size_str), "%.1f GB", segments[i].size_bytes / (1024.0 * 1024.0 * 1024.0));
         }
         
-        cJSON_AddNumberToObject(segment, "id", segments[i].id);
-        cJSON_AddStringToObject(segment, "stream", segments[i].stream_name);
-        cJSON_AddStringToObject(segment, "start_time", segment_start_time);
-        cJSON_AddStringToObject(segment, "end_time", segment_end_time);
-        cJSON_AddNumberToObject(segment, "duration", duration);
-        cJSON_AddStringToObject(segment, "size", size_str);
-        cJSON_AddBoolToObject(segment, "has_detection", segments[i].has_detection);
-        
-        // Add Unix timestamps for easier frontend processing
-        // Convert to local timezone by adding the timezone offset
-        struct tm *tm_start = localtime(&segments[i].start_time);
-        struct tm *tm_end = localtime(&segments[i].end_time);
-        
-        // Calculate timezone offset in seconds
-        time_t timezone_offset = tm_start->tm_gmtoff;
-        
-        // Add timestamps adjusted for local timezone
-        cJSON_AddNumberToObject(segment, "start_timestamp", (double)segments[i].start_time);
-        cJSON_AddNumberToObject(segment, "end_timestamp", (double)segments[i].end_time);
+        json_write_object_start(w, NULL);
+        json_write_number(w, "id", segments[i].id);
+        json_write_string(w, "stream", segments[i].stream_name);
+        json_write_string(w, "start_time", segment_start_time);
+        json_write_string(w, "end_time", segment_end_time);
+        json_write_number(w, "duration", duration);
+        json_write_string(w, "size", size_str);
+        json_write_bool(w, "has_detection", segments[i].has_detection);
         
-        // Add local timestamps (without timezone adjustment - the browser will handle timezone display)
-        cJSON_AddNumberToObject(segment, "local_start_timestamp", (double)segments[i].start_time);
-        cJSON_AddNumberToObject(segment, "local_end_timestamp", (double)segments[i].end_time);
+        // Unix timestamps for easier frontend processing
+        json_write_number(w, "start_timestamp", (double)segments[i].start_time);
+        json_write_number(w, "end_timestamp", (double)segments[i].end_time);
         
-        cJSON_AddItemToArray(segments_array, segment);
+        // Local timestamps (without timezone adjustment - the browser will handle timezone display)
+        json_write_number(w, "local_start_timestamp", (double)segments[i].start_time);
+        json_write_number(w, "local_end_timestamp", (double)segments[i].end_time);
+        json_write_object_end(w);
     }
     
-    // Free segments
-    free(segments);
+    release_timeline();
     
-    // Convert to string
-    char *json_str = cJSON_PrintUnformatted(response);
-    if (!json_str) {
-        log_error("Failed to convert response JSON to string");
-        cJSON_Delete(response);
-        mg_send_json_error(c, 500, "Failed to convert response JSON to string");
-        return;
-    }
+    json_write_array_end(w);
     
-    // Send response
-    mg_send_json_response(c, 200, json_str);
+    // Add metadata
+    json_write_string(w, "stream", stream_name);
+    json_write_string(w, "start_time", start_time_display);
+    json_write_string(w, "end_time", end_time_display);
+    json_write_number(w, "segment_count", count);
     
-    free(json_str);
-    cJSON_Delete(response);
+    json_write_object_end(w);
+    json_writer_end(w);
     
     log_info("Successfully handled GET /api/timeline/segments request");
 }
 
+/**
+ * Parse a time given as Unix seconds or as local ISO 8601
+ */
+static bool parse_time_param(const char *value, time_t *out) {
+    char *end = NULL;
+    long long seconds = strtoll(value, &end, 10);
+    if (end != value && *end == '\0') {
+        *out = (time_t)seconds;
+        return true;
+    }
+
+    struct tm tm = {0};
+    const char *rest = strptime(value, "%Y-%m-%dT%H:%M:%S", &tm);
+    if (!rest) {
+        return false;
+    }
+    tm.tm_isdst = -1;
+    *out = mktime(&tm);
+    return true;
+}
+
+/**
+ * @brief Direct handler for GET /api/timeline/activity
+ *
+ * Detection activity of a stream, or of all streams, in buckets of whole
+ * minutes read from the per-minute rollup. Takes start and end (Unix
+ * seconds or ISO 8601, default the last 24 hours) and either bucket (seconds)
+ * or buckets (count, default 288).
+ */
+void mg_handle_get_timeline_activity(struct mg_connection *c, struct mg_http_message *hm) {
+    char stream_name[MAX_STREAM_NAME] = {0};
+    char value[64];
+
+    mg_http_get_var(&hm->query, "stream", stream_name, sizeof(stream_name));
+
+    time_t end_time = time(NULL);
+    if (mg_http_get_var(&hm->query, "end", value, sizeof(value)) > 0 &&
+        !parse_time_param(value, &end_time)) {
+        mg_send_json_error(c, 400, "Invalid end time");
+        return;
+    }
+    time_t start_time = end_time - 24 * 60 * 60;
+    if (mg_http_get_var(&hm->query, "start", value, sizeof(value)) > 0 &&
+        !parse_time_param(value, &start_time)) {
+        mg_send_json_error(c, 400, "Invalid start time");
+        return;
+    }
+    if (end_time <= start_time) {
+        mg_send_json_error(c, 400, "End time must be after start time");
+        return;
+    }
+
+    // Buckets are whole minutes, the resolution of the rollup
+    long long bucket_seconds = 0;
+    if (mg_http_get_var(&hm->query, "bucket", value, sizeof(value)) > 0) {
+        bucket_seconds = strtoll(value, NULL, 10);
+    } else {
+        int buckets = ACTIVITY_DEFAULT_BUCKETS;
+        if (mg_http_get_var(&hm->query, "buckets", value, sizeof(value)) > 0) {
+            buckets = atoi(value);
+        }
+        if (buckets <= 0) {
+            mg_send_json_error(c, 400, "Invalid number of buckets");
+            return;
+        }
+        bucket_seconds = ((long long)(end_time - start_time) + buckets - 1) / buckets;
+    }
+    bucket_seconds = bucket_seconds < 60 ? 60 : (bucket_seconds + 59) / 60 * 60;
+    if ((long long)(end_time - start_time) / bucket_seconds > ACTIVITY_MAX_BUCKETS) {
+        mg_send_json_error(c, 400, "Too many buckets for the time range");
+        return;
+    }
+
+    activity_bucket_t *buckets = NULL;
+    int count = get_detection_activity(stream_name[0] ? stream_name : NULL, start_time, end_time,
+                                       (int)bucket_seconds, &buckets);
+    if (count < 0) {
+        mg_send_json_error(c, 500, "Failed to get detection activity");
+        return;
+    }
+
+    json_writer_t writer;
+    json_writer_t *w = &writer;
+    json_writer_begin(w, c, 200);
+    json_write_object_start(w, NULL);
+    if (stream_name[0]) {
+        json_write_string(w, "stream", stream_name);
+    }
+    json_write_number(w, "start", (double)(start_time - start_time % 60));
+    json_write_number(w, "end", (double)end_time);
+    json_write_number(w, "bucket_seconds", (double)bucket_seconds);
+
+    // Only buckets with detections, so a quiet week is a short answer
+    json_write_array_start(w, "buckets");
+    for (int i = 0; i < count; i++) {
+        json_write_object_start(w, NULL);
+        json_write_number(w, "start", (double)buckets[i].start);
+        json_write_number(w, "count", buckets[i].count);
+        json_write_number(w, "motion", buckets[i].motion);
+        json_write_object_start(w, "labels");
+        for (int l = 0; l < buckets[i].label_count; l++) {
+            json_write_number(w, buckets[i].labels[l].label, buckets[i].labels[l].count);
+        }
+        json_write_object_end(w);
+        json_write_object_end(w);
+    }
+    json_write_array_end(w);
+
+    json_write_object_end(w);
+    json_writer_end(w);
+
+    free(buckets);
+}
+
+/**
+ * Write the segments of one stream, joining those at most gap seconds apart
+ * when gap is not negative
+ */
+static void write_stream_segments(json_writer_t *w, const char *stream_name, const recording_span_t *spans,
+                                  int count, long gap) {
+    json_write_object_start(w, NULL);
+    json_write_string(w, "stream", stream_name);
+    json_write_array_start(w, "segments");
+
+    int segment_count = 0;
+    int i = 0;
+    while (i < count) {
+        time_t end_time = spans[i].end_time;
+        uint64_t size_bytes = spans[i].size_bytes;
+        int j = i + 1;
+        while (gap >= 0 && j < count && spans[j].start_time <= end_time + gap) {
+            if (spans[j].end_time > end_time) {
+                end_time = spans[j].end_time;
+            }
+            size_bytes += spans[j].size_bytes;
+            j++;
+        }
+
+        json_write_object_start(w, NULL);
+        json_write_number(w, "id", (double)spans[i].id);
+        json_write_number(w, "start_timestamp", (double)spans[i].start_time);
+        json_write_number(w, "end_timestamp", (double)end_time);
+        json_write_number(w, "size_bytes", (double)size_bytes);
+        if (gap >= 0) {
+            json_write_number(w, "recordings", j - i);
+        }
+        json_write_object_end(w);
+
+        segment_count++;
+        i = j;
+    }
+
+    json_write_array_end(w);
+    json_write_number(w, "segment_count", segment_count);
+    json_write_object_end(w);
+}
+
+/**
+ * @brief Direct handler for GET /api/timeline/segments/batch
+ *
+ * Segments of several streams from one query. Takes streams (comma-separated),
+ * start and end (Unix seconds or ISO 8601, default the last 24 hours) and
+ * optionally coalesce, the largest gap in seconds between recordings that
+ * are returned as one segment.
+ */
+void mg_handle_get_timeline_segments_batch(struct mg_connection *c, struct mg_http_message *hm) {
+    char streams[MAX_STREAMS * 65] = {0};
+    char value[64];
+
+    if (mg_http_get_var(&hm->query, "streams", streams, sizeof(streams)) <= 0) {
+        mg_send_json_error(c, 400, "Missing required parameter: streams");
+        return;
+    }
+
+    // Names in the order asked for, each answered even without recordings
+    char *names[MAX_STREAMS];
+    int name_count = 0;
+    char names_buf[sizeof(streams)];
+    memcpy(names_buf, streams, sizeof(names_buf));
+    char *saveptr = NULL;
+    for (char *name = strtok_r(names_buf, ",", &saveptr); name; name = strtok_r(NULL, ",", &saveptr)) {
+        if (name_count == MAX_STREAMS) {
+            mg_send_json_error(c, 400, "Too many streams");
+            return;
+        }
+        names[name_count++] = name;
+    }
+    if (name_count == 0) {
+        mg_send_json_error(c, 400, "Missing required parameter: streams");
+        return;
+    }
+
+    time_t end_time = time(NULL);
+    if (mg_http_get_var(&hm->query, "end", value, sizeof(value)) > 0 &&
+        !parse_time_param(value, &end_time)) {
+        mg_send_json_error(c, 400, "Invalid end time");
+        return;
+    }
+    time_t start_time = end_time - 24 * 60 * 60;
+    if (mg_http_get_var(&hm->query, "start", value, sizeof(value)) > 0 &&
+        !parse_time_param(value, &start_time)) {
+        mg_send_json_error(c, 400, "Invalid start time");
+        return;
+    }
+
+    long gap = -1;
+    if (mg_http_get_var(&hm->query, "coalesce", value, sizeof(value)) > 0) {
+        gap = strtol(value, NULL, 10);
+        if (gap < 0) {
+            mg_send_json_error(c, 400, "Invalid coalesce gap");
+            return;
+        }
+    }
+
+    int max_spans = MAX_TIMELINE_SEGMENTS * name_count;
+    recording_span_t *spans = NULL;
+    int count = get_recording_spans(streams, start_time, end_time, max_spans, &spans);
+    if (count < 0) {
+        mg_send_json_error(c, 500, "Failed to get timeline segments");
+        return;
+    }
+
+    json_writer_t writer;
+    json_writer_t *w = &writer;
+    json_writer_begin(w, c, 200);
+    json_write_object_start(w, NULL);
+    json_write_number(w, "start", (double)start_time);
+    json_write_number(w, "end", (double)end_time);
+    json_write_bool(w, "truncated", count == max_spans);
+
+    // Spans come grouped by stream, so each stream is one run
+    json_write_array_start(w, "streams");
+    for (int n = 0; n < name_count; n++) {
+        int first = 0;
+        while (first < count && strcmp(spans[first].stream_name, names[n]) != 0) {
+            first++;
+        }
+        int last = first;
+        while (last < count && strcmp(spans[last].stream_name, names[n]) == 0) {
+            last++;
+        }
+        write_stream_segments(w, names[n], spans + first, last - first, gap);
+    }
+    json_write_array_end(w);
+
+    json_write_object_end(w);
+    json_writer_end(w);
+
+    free(spans);
+}
+
 
 /**
  * Create a playback manifest for a sequence of recordings
  */
-int create_timeline_manifest(const timeline_segment_t *segments, int segment_count,
-                            time_t start_time, char *manifest_path) {
-    if (!segments || segment_count <= 0 || !manifest_path) {
+char *create_timeline_manifest(const timeline_segment_t *segments, int segment_count,
+                               time_t start_time, time_t end_time, bool h264, size_t *length) {
+    if (!segments || segment_count <= 0 || !length) {
         log_error("Invalid parameters for create_timeline_manifest");
-        return -1;
+        return NULL;
     }
     
     // Limit the number of segments
@@ -369,95 +694,56 @@ int create_timeline_manifest(const timeline_segment_t *segments, int segment_cou
         segment_count = MAX_MANIFEST_SEGMENTS;
     }
     
-    // Create a temporary directory for the manifest
-    char temp_dir[MAX_PATH_LENGTH];
-    snprintf(temp_dir, sizeof(temp_dir), "%s/timeline_manifests", g_config.storage_path);
-    
-    // Create directory if it doesn't exist
-    struct stat st = {0};
-    if (stat(temp_dir, &st) == -1) {
-        mkdir(temp_dir, 0755);
-    }
-    
-    // Generate a unique manifest filename
-    char manifest_filename[MAX_PATH_LENGTH];
-    snprintf(manifest_filename, sizeof(manifest_filename), "%s/manifest_%ld_%s_%ld.m3u8",
-            temp_dir, (long)time(NULL), segments[0].stream_name, (long)start_time);
-    
-    // Lock mutex for manifest creation
-    pthread_mutex_lock(&manifest_mutex);
-    
-    // Create manifest file
-    FILE *manifest = fopen(manifest_filename, "w");
-    if (!manifest) {
-        log_error("Failed to create manifest file: %s", manifest_filename);
-        pthread_mutex_unlock(&manifest_mutex);
-        return -1;
+    recording_metadata_t *recordings = calloc(segment_count, sizeof(recording_metadata_t));
+    recording_vod_item_t *items = calloc(segment_count, sizeof(recording_vod_item_t));
+    if (!recordings || !items) {
+        log_error("Failed to allocate memory for timeline manifest");
+        free(recordings);
+        free(items);
+        return NULL;
     }
     
-    // Write manifest header
-    fprintf(manifest, "#EXTM3U\n");
-    fprintf(manifest, "#EXT-X-VERSION:3\n");
-    fprintf(manifest, "#EXT-X-MEDIA-SEQUENCE:0\n");
-    fprintf(manifest, "#EXT-X-ALLOW-CACHE:YES\n");
-    
-    // Find the maximum segment duration for EXT-X-TARGETDURATION
-    double max_duration = 0;
+    // Recordings are played from the start time to the end time, skipping
+    // those whose file is gone
+    int count = 0;
     for (int i = 0; i < segment_count; i++) {
-        double duration = difftime(segments[i].end_time, segments[i].start_time);
-        if (duration > max_duration) {
-            max_duration = duration;
+        if ((segments[i].end_time > 0 && segments[i].end_time <= start_time) || segments[i].start_time >= end_time) {
+            continue;
         }
-    }
-    // Round up to the nearest integer and add a small buffer
-    int target_duration = (int)max_duration + 1;
-    fprintf(manifest, "#EXT-X-TARGETDURATION:%d\n", target_duration);
-    
-    // Find the segment that contains the start time
-    int start_segment_index = -1;
-    for (int i = 0; i < segment_count; i++) {
-        if (start_time >= segments[i].start_time && start_time <= segments[i].end_time) {
-            start_segment_index = i;
-            break;
+        
+        struct stat st;
+        recording_metadata_t *recording = &recordings[count];
+        if (get_recording_metadata_by_id(segments[i].id, recording) != 0 ||
+            locate_recording_file(recording, &st) != 0) {
+            continue;
         }
-    }
-    
-    // If no segment contains the start time, use the first segment after the start time
-    if (start_segment_index == -1) {
-        for (int i = 0; i < segment_count; i++) {
-            if (start_time < segments[i].start_time) {
-                start_segment_index = i;
-                break;
-            }
+        
+        recording_vod_item_t *item = &items[count++];
+        item->id = recording->id;
+        item->file_path = recording->file_path;
+        item->start_time = segments[i].start_time;
+        item->h264 = h264;
+        if (start_time > segments[i].start_time) {
+            item->from_ms = (int64_t)(start_time - segments[i].start_time) * 1000;
+        }
+        if (end_time > segments[i].start_time && end_time < segments[i].end_time) {
+            item->to_ms = (int64_t)(end_time - segments[i].start_time) * 1000;
+        }
+        
+        // A recording compacted into a shared file is its part of that file
+        compacted_recording_t place;
+        if (get_recording_compaction(recording->id, &place) == 1) {
+            item->start_time -= (time_t)(place.offset_ms / 1000);
+            item->from_ms += place.offset_ms;
+            item->to_ms = place.offset_ms + (item->to_ms > 0 ? item->to_ms : place.duration_ms);
         }
     }
     
-    // If still no segment found, use the first segment
-    if (start_segment_index == -1 && segment_count > 0) {
-        start_segment_index = 0;
-    }
-    
-    // Create a single segment for the entire timeline
-    // This simplifies playback and avoids issues with segment transitions
-    fprintf(manifest, "#EXTINF:%.6f,\n", max_duration);
-    fprintf(manifest, "/api/timeline/play?stream=%s&start=%ld\n", 
-            segments[0].stream_name, (long)start_time);
-    
-    // Write manifest end
-    fprintf(manifest, "#EXT-X-ENDLIST\n");
-    
-    // Close manifest file
-    fclose(manifest);
-    
-    // Copy manifest path to output
-    strncpy(manifest_path, manifest_filename, MAX_PATH_LENGTH - 1);
-    manifest_path[MAX_PATH_LENGTH - 1] = '\0';
-    
-    pthread_mutex_unlock(&manifest_mutex);
-    
-    log_info("Created timeline manifest: %s", manifest_filename);
+    char *manifest = count > 0 ? recording_vod_build_playlist(items, count, length) : NULL;
     
-    return 0;
+    free(items);
+    free(recordings);
+    return manifest;
 }
 
 /**
@@ -493,6 +779,11 @@ void mg_handle_timeline_manifest(struct mg_connection *c, struct mg_http_message
     // Extract end parameter
     mg_http_get_var(&hm->query, "end", end_time_str, sizeof(end_time_str));
     
+    // Players that cannot decode HEVC ask for ?codec=h264
+    char codec[16] = {0};
+    mg_http_get_var(&hm->query, "codec", codec, sizeof(codec));
+    bool h264 = strcmp(codec, "h264") == 0;
+    
     // Check required parameters
     if (stream_name[0] == '\0') {
         log_error("Missing required parameter: stream");
@@ -589,47 +880,49 @@ void mg_handle_timeline_manifest(struct mg_connection *c, struct mg_http_message
     }
     
     // Get timeline segments
-    timeline_segment_t *segments = (timeline_segment_t *)malloc(MAX_TIMELINE_SEGMENTS * sizeof(timeline_segment_t));
-    if (!segments) {
-        log_error("Failed to allocate memory for timeline segments");
-        mg_send_json_error(c, 500, "Failed to allocate memory for timeline segments");
+    timeline_cache_entry_t *timeline = acquire_timeline(stream_name, start_time, end_time);
+    if (!timeline) {
+        log_error("Failed to get timeline segments");
+        mg_send_json_error(c, 500, "Failed to get timeline segments");
         return;
     }
     
-    int count = get_timeline_segments(stream_name, start_time, end_time, segments, MAX_TIMELINE_SEGMENTS);
-    
-    if (count <= 0) {
+    if (timeline->count <= 0) {
         log_error("No timeline segments found for stream %s", stream_name);
-        free(segments);
+        release_timeline();
         mg_send_json_error(c, 404, "No recordings found for the specified time range");
         return;
     }
     
-    // Create manifest
-    char manifest_path[MAX_PATH_LENGTH];
-    if (create_timeline_manifest(segments, count, start_time, manifest_path) != 0) {
-        log_error("Failed to create timeline manifest");
-        free(segments);
+    // The manifest reads the recordings' keyframe indexes, so it is made
+    // from a copy rather than holding the cache locked
+    int count = timeline->count;
+    timeline_segment_t *segments = (timeline_segment_t *)malloc(count * sizeof(timeline_segment_t));
+    if (!segments) {
+        release_timeline();
         mg_send_json_error(c, 500, "Failed to create timeline manifest");
         return;
     }
+    memcpy(segments, timeline->segments, count * sizeof(timeline_segment_t));
+    release_timeline();
     
-    // Free segments
+    size_t manifest_len = 0;
+    char *manifest = create_timeline_manifest(segments, count, start_time, end_time, h264, &manifest_len);
     free(segments);
+    if (!manifest) {
+        log_error("Failed to create timeline manifest");
+        mg_send_json_error(c, 404, "No playable recordings found for the specified time range");
+        return;
+    }
     
-    // Use Mongoose's built-in file serving capabilities
-    // This is more stable and handles all the HTTP headers properly
-    struct mg_http_serve_opts opts = {
-        .mime_types = "m3u8=application/vnd.apple.mpegurl",
-        .extra_headers = "Connection: close\r\nCache-Control: no-cache\r\n"
-    };
-    
-    log_info("Serving manifest file using mg_http_serve_file: %s", manifest_path);
-    mg_http_serve_file(c, hm, manifest_path, &opts);
-    
-    // Schedule manifest file for deletion after a while
-    // In a real implementation, you might want to keep it around for a bit
-    // and implement a cleanup mechanism
+    mg_printf(c, "HTTP/1.1 200 OK\r\n"
+                 "Content-Type: application/vnd.apple.mpegurl\r\n"
+                 "Connection: close\r\n"
+                 "Cache-Control: no-cache\r\n"
+                 "Content-Length: %zu\r\n"
+                 "\r\n", manifest_len);
+    mg_send(c, manifest, manifest_len);
+    free(manifest);
     
     log_info("Successfully handled GET /api/timeline/manifest request");
 }
@@ -724,30 +1017,32 @@ void mg_handle_timeline_playback(struct mg_connection *c, struct mg_http_message
         start_time = time(NULL) - (24 * 60 * 60);
     }
     
-    // Get timeline segments
-    timeline_segment_t *segments = (timeline_segment_t *)malloc(MAX_TIMELINE_SEGMENTS * sizeof(timeline_segment_t));
-    if (!segments) {
-        log_error("Failed to allocate memory for timeline segments");
-        mg_send_json_error(c, 500, "Failed to allocate memory for timeline segments");
+    // Get segments for the next 24 hours from start time
+    time_t end_time = start_time + (24 * 60 * 60);
+    timeline_cache_entry_t *timeline = acquire_timeline(stream_name, start_time, end_time);
+    if (!timeline) {
+        log_error("Failed to get timeline segments");
+        mg_send_json_error(c, 500, "Failed to get timeline segments");
         return;
     }
     
-    // Get segments for the next 24 hours from start time
-    time_t end_time = start_time + (24 * 60 * 60);
-    int count = get_timeline_segments(stream_name, start_time, end_time, segments, MAX_TIMELINE_SEGMENTS);
+    const timeline_segment_t *segments = timeline->segments;
+    int count = timeline->count;
     
     if (count <= 0) {
         log_error("No timeline segments found for stream %s", stream_name);
-        free(segments);
+        release_timeline();
         mg_send_json_error(c, 404, "No recordings found for the specified time range");
         return;
     }
     
     // Find the segment that contains the start time
     int start_segment_index = -1;
+    time_t offset_in_segment = 0;
     for (int i = 0; i < count; i++) {
         if (start_time >= segments[i].start_time && start_time <= segments[i].end_time) {
             start_segment_index = i;
+            offset_in_segment = start_time - segments[i].start_time;
             break;
         }
     }
@@ -770,12 +1065,17 @@ void mg_handle_timeline_playback(struct mg_connection *c, struct mg_http_message
     // Get the recording ID for the segment
     uint64_t recording_id = segments[start_segment_index].id;
     
-    // Free segments
-    free(segments);
+    release_timeline();
     
-    // Redirect to the recording playback endpoint
+    // Redirect to the recording playback endpoint; with an offset it starts at the
+    // fragment covering the start time instead of at the beginning of the recording
     char redirect_url[256];
-    snprintf(redirect_url, sizeof(redirect_url), "/api/recordings/play/%llu", (unsigned long long)recording_id);
+    if (offset_in_segment > 0) {
+        snprintf(redirect_url, sizeof(redirect_url), "/api/recordings/play/%llu?t=%lld",
+                 (unsigned long long)recording_id, (long long)offset_in_segment);
+    } else {
+        snprintf(redirect_url, sizeof(redirect_url), "/api/recordings/play/%llu", (unsigned long long)recording_id);
+    }
     
     log_info("Redirecting to recording playback: %s", redirect_url);
     
@@ -795,30 +795,11 @@ void mg_handle_users_update(struct mg_connection *c, struct mg_http_message *hm)
     // Send an immediate response to the client before processing the request
     mg_send_json_response(c, 202, "{\"success\":true,\"message\":\"Processing request\"}");
 
-    // Create a thread data structure
-    struct mg_thread_data *data = calloc(1, sizeof(struct mg_thread_data));
-    if (!data) {
-        log_error("Failed to allocate memory for thread data");
-        mg_http_reply(c, 500, "", "Internal Server Error\n");
+    // Queue for a worker thread; errors have been answered already
+    if (!mg_offload_request(c, hm, users_update_handler)) {
         return;
     }
 
-    // Copy the HTTP message
-    data->message = mg_strdup(hm->message);
-    if (data->message.len == 0) {
-        log_error("Failed to duplicate HTTP message");
-        free(data);
-        return;
-    }
-
-    // Set connection ID, manager, and handler function
-    data->conn_id = c->id;
-    data->mgr = c->mgr;
-    data->handler_func = users_update_handler;
-
-    // Start thread
-    mg_start_thread(mg_thread_function, data);
-
     log_info("User update task started in a worker thread");
 }
 
@@ -964,30 +945,11 @@ void mg_handle_users_delete(struct mg_connection *c, struct mg_http_message *hm)
     // Send an immediate response to the client before processing the request
     mg_send_json_response(c, 202, "{\"success\":true,\"message\":\"Processing request\"}");
 
-    // Create a thread data structure
-    struct mg_thread_data *data = calloc(1, sizeof(struct mg_thread_data));
-    if (!data) {
-        log_error("Failed to allocate memory for thread data");
-        mg_http_reply(c, 500, "", "Internal Server Error\n");
+    // Queue for a worker thread; errors have been answered already
+    if (!mg_offload_request(c, hm, users_delete_handler)) {
         return;
     }
 
-    // Copy the HTTP message
-    data->message = mg_strdup(hm->message);
-    if (data->message.len == 0) {
-        log_error("Failed to duplicate HTTP message");
-        free(data);
-        return;
-    }
-
-    // Set connection ID, manager, and handler function
-    data->conn_id = c->id;
-    data->mgr = c->mgr;
-    data->handler_func = users_delete_handler;
-
-    // Start thread
-    mg_start_thread(mg_thread_function, data);
-
     log_info("User delete task started in a worker thread");
 }
 
@@ -0,0 +1,342 @@
+/**
+ * @file api_response_cache.c
+ * @brief Cache of API responses, invalidated by data versions
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "web/api_response_cache.h"
+#include "web/api_response_compress.h"
+#include "video/stream_state.h"
+#include "core/logger.h"
+#include "core/metrics.h"
+#include "utils/memory.h"
+#include "mongoose.h"
+
+// Responses kept at most
+#define API_CACHE_ENTRIES 64
+
+// Larger responses are not cached
+#define API_CACHE_MAX_ENTRY (512 * 1024)
+
+// Memory all cached responses may take
+#define API_CACHE_MAX_TOTAL (4 * 1024 * 1024)
+
+typedef struct {
+    uint64_t key;
+    uint64_t version;
+    char *data;             // Complete HTTP response, headers included
+    size_t size;
+    uint64_t last_used;
+} cache_entry_t;
+
+static cache_entry_t entries[API_CACHE_ENTRIES];
+static size_t cached_bytes = 0;
+static uint64_t use_clock = 0;
+static pthread_mutex_t cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t settings_version = 0;
+
+// Distinguishes ETags of this process from those of an earlier one, whose
+// versions started at 0 as well
+static uint64_t boot_id = 0;
+
+static metric_t hit_metric;
+static metric_t not_modified_metric;
+static metric_t miss_metric;
+
+static uint64_t hash_bytes(uint64_t hash, const void *data, size_t len) {
+    const unsigned char *p = data;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= p[i];
+        hash *= 1099511628211ULL;
+    }
+    // Separates the fields, so "ab"+"c" and "a"+"bc" differ
+    hash ^= 0xff;
+    hash *= 1099511628211ULL;
+    return hash;
+}
+
+static uint64_t hash_header(uint64_t hash, struct mg_http_message *hm, const char *name) {
+    struct mg_str *value = mg_http_get_header(hm, name);
+    return value ? hash_bytes(hash, value->buf, value->len) : hash_bytes(hash, "", 0);
+}
+
+static uint64_t dependency_version(unsigned int deps) {
+    uint64_t version = 0;
+    for (int i = 0; i < DB_TABLE_COUNT; i++) {
+        if (deps & API_CACHE_TABLE(i)) {
+            version += get_table_version((db_table_t)i);
+        }
+    }
+    if (deps & API_CACHE_STREAM_STATE) {
+        version += get_stream_state_version();
+    }
+    if (deps & API_CACHE_SETTINGS) {
+        version += __atomic_load_n(&settings_version, __ATOMIC_ACQUIRE);
+    }
+    if (deps & API_CACHE_CLOCK) {
+        version += (uint64_t)time(NULL) / API_CACHE_CLOCK_SECONDS;
+    }
+    return version;
+}
+
+static void format_etag(const api_cache_ctx_t *ctx, char *etag, size_t size) {
+    snprintf(etag, size, "\"%016llx-%llx-%llx\"", (unsigned long long)ctx->key,
+             (unsigned long long)boot_id, (unsigned long long)ctx->version);
+}
+
+// Whether If-None-Match names the ETag
+static bool etag_matches(struct mg_http_message *hm, const char *etag) {
+    struct mg_str *header = mg_http_get_header(hm, "If-None-Match");
+    if (!header) {
+        return false;
+    }
+
+    char buf[512];
+    size_t len = header->len < sizeof(buf) - 1 ? header->len : sizeof(buf) - 1;
+    memcpy(buf, header->buf, len);
+    buf[len] = '\0';
+    return strstr(buf, etag) != NULL;
+}
+
+static void free_entry(cache_entry_t *entry) {
+    if (entry->data) {
+        memory_track(MEMORY_TAG_WEB, entry->size, false);
+        cached_bytes -= entry->size;
+        free(entry->data);
+    }
+    memset(entry, 0, sizeof(*entry));
+}
+
+static void register_metrics(void) {
+    hit_metric = metrics_counter("lightnvr_api_cache_requests_total",
+                                 "Cached API route requests by outcome", "result", "hit", NULL);
+    not_modified_metric = metrics_counter("lightnvr_api_cache_requests_total",
+                                          "Cached API route requests by outcome", "result", "not_modified", NULL);
+    miss_metric = metrics_counter("lightnvr_api_cache_requests_total",
+                                  "Cached API route requests by outcome", "result", "miss", NULL);
+}
+
+bool api_cache_lookup(struct mg_connection *c, struct mg_http_message *hm, unsigned int deps,
+                      api_cache_ctx_t *ctx) {
+    memset(ctx, 0, sizeof(*ctx));
+    if (deps == 0 || mg_strcmp(hm->method, mg_str("GET")) != 0) {
+        return false;
+    }
+
+    // Only the event loop thread gets here, and it does before any store
+    if (boot_id == 0) {
+        boot_id = (uint64_t)time(NULL);
+        register_metrics();
+    }
+
+    // The version is read before the handler runs, so the response it
+    // builds is at least as new
+    ctx->version = dependency_version(deps);
+
+    // Responses may differ between users, and are stored compressed
+    api_encoding_t encoding = api_response_encoding(hm);
+    uint64_t key = 14695981039346656037ULL;
+    key = hash_bytes(key, hm->uri.buf, hm->uri.len);
+    key = hash_bytes(key, hm->query.buf, hm->query.len);
+    key = hash_header(key, hm, "Authorization");
+    key = hash_header(key, hm, "Cookie");
+    key = hash_bytes(key, &encoding, sizeof(encoding));
+    ctx->key = key;
+    ctx->active = true;
+
+    char etag[64];
+    format_etag(ctx, etag, sizeof(etag));
+    if (etag_matches(hm, etag)) {
+        mg_printf(c, "HTTP/1.1 304 Not Modified\r\n"
+                     "ETag: %s\r\n"
+                     "Cache-Control: no-cache, must-revalidate\r\n"
+                     "Access-Control-Allow-Origin: *\r\n"
+                     "Access-Control-Allow-Credentials: true\r\n"
+                     "Content-Length: 0\r\n\r\n", etag);
+        metrics_add(not_modified_metric, 1);
+        ctx->active = false;
+        return true;
+    }
+
+    pthread_mutex_lock(&cache_mutex);
+    for (int i = 0; i < API_CACHE_ENTRIES; i++) {
+        cache_entry_t *entry = &entries[i];
+        if (!entry->data || entry->key != key) {
+            continue;
+        }
+        if (entry->version == ctx->version) {
+            entry->last_used = ++use_clock;
+            mg_send(c, entry->data, entry->size);
+            pthread_mutex_unlock(&cache_mutex);
+            metrics_add(hit_metric, 1);
+            ctx->active = false;
+            return true;
+        }
+        // Versions only grow, so an entry behind is never used again
+        if (entry->version < ctx->version) {
+            free_entry(entry);
+        }
+        break;
+    }
+    pthread_mutex_unlock(&cache_mutex);
+
+    metrics_add(miss_metric, 1);
+    return false;
+}
+
+// Find the end of the headers of a response
+static const char *find_header_end(const char *data, size_t size) {
+    for (size_t i = 0; i + 4 <= size; i++) {
+        if (memcmp(data + i, "\r\n\r\n", 4) == 0) {
+            return data + i;
+        }
+    }
+    return NULL;
+}
+
+// Whether a response is complete: Content-Length bytes, or a last chunk
+// headers holds a terminated copy of the headers ending at head_end
+static bool response_complete(const char *head_end, const char *end, const char *headers) {
+    const char *body = head_end + 4;
+    const char *length = strcasestr(headers, "\r\nContent-Length:");
+    if (length) {
+        long expected = strtol(length + 17, NULL, 10);
+        return expected >= 0 && end - body == expected;
+    }
+    return end - body >= 5 && memcmp(end - 5, "0\r\n\r\n", 5) == 0;
+}
+
+void api_cache_store(const api_cache_ctx_t *ctx, struct mg_connection *c, size_t start) {
+    if (!ctx || !ctx->active || c->send.len <= start) {
+        return;
+    }
+
+    const char *data = (const char *)c->send.buf + start;
+    size_t size = c->send.len - start;
+    if (size < 13 || memcmp(data, "HTTP/1.1 200 ", 13) != 0 || size > API_CACHE_MAX_ENTRY) {
+        return;
+    }
+    const char *head_end = find_header_end(data, size);
+    if (!head_end) {
+        return;
+    }
+
+    // Work on a terminated copy of the headers
+    size_t head_len = (size_t)(head_end - data);
+    char *headers = malloc(head_len + 1);
+    if (!headers) {
+        return;
+    }
+    memcpy(headers, data, head_len);
+    headers[head_len] = '\0';
+    if (!response_complete(head_end, data + size, headers)) {
+        free(headers);
+        return;
+    }
+
+    // Browsers only revalidate what they may store
+    const char *no_store = strstr(headers, "no-store, ");
+    size_t cut = no_store ? strlen("no-store, ") : 0;
+
+    char etag[64];
+    format_etag(ctx, etag, sizeof(etag));
+    char etag_line[96];
+    int etag_len = snprintf(etag_line, sizeof(etag_line), "\r\nETag: %s", etag);
+
+    size_t body_len = size - head_len;
+    size_t out_size = head_len - cut + (size_t)etag_len + body_len;
+    char *out = malloc(out_size);
+    if (!out) {
+        free(headers);
+        return;
+    }
+    if (no_store) {
+        size_t before = (size_t)(no_store - headers);
+        memcpy(out, headers, before);
+        memcpy(out + before, no_store + cut, head_len - before - cut);
+    } else {
+        memcpy(out, headers, head_len);
+    }
+    size_t pos = head_len - cut;
+    memcpy(out + pos, etag_line, (size_t)etag_len);
+    pos += (size_t)etag_len;
+    memcpy(out + pos, head_end, body_len);
+    free(headers);
+
+    // Replace what the handler wrote
+    c->send.len = start;
+    mg_send(c, out, out_size);
+
+    if (!memory_budget_allows(MEMORY_TAG_WEB, out_size)) {
+        free(out);
+        return;
+    }
+
+    pthread_mutex_lock(&cache_mutex);
+
+    // Reuse the entry of the same request, or an empty one
+    cache_entry_t *slot = NULL;
+    for (int i = 0; i < API_CACHE_ENTRIES; i++) {
+        if (entries[i].data && entries[i].key == ctx->key) {
+            // A newer response was stored meanwhile
+            if (entries[i].version > ctx->version) {
+                pthread_mutex_unlock(&cache_mutex);
+                free(out);
+                return;
+            }
+            free_entry(&entries[i]);
+            slot = &entries[i];
+            break;
+        }
+        if (!slot && !entries[i].data) {
+            slot = &entries[i];
+        }
+    }
+
+    // Evict the least recently used responses until this one fits
+    while (!slot || cached_bytes + out_size > API_CACHE_MAX_TOTAL) {
+        cache_entry_t *oldest = NULL;
+        for (int i = 0; i < API_CACHE_ENTRIES; i++) {
+            if (entries[i].data && (!oldest || entries[i].last_used < oldest->last_used)) {
+                oldest = &entries[i];
+            }
+        }
+        if (!oldest) {
+            break;
+        }
+        free_entry(oldest);
+        if (!slot) {
+            slot = oldest;
+        }
+    }
+
+    slot->key = ctx->key;
+    slot->version = ctx->version;
+    slot->data = out;
+    slot->size = out_size;
+    slot->last_used = ++use_clock;
+    cached_bytes += out_size;
+    memory_track(MEMORY_TAG_WEB, out_size, true);
+    pthread_mutex_unlock(&cache_mutex);
+}
+
+void api_cache_settings_changed(void) {
+    __atomic_fetch_add(&settings_version, 1, __ATOMIC_RELEASE);
+}
+
+void api_cache_free(void) {
+    pthread_mutex_lock(&cache_mutex);
+    for (int i = 0; i < API_CACHE_ENTRIES; i++) {
+        free_entry(&entries[i]);
+    }
+    pthread_mutex_unlock(&cache_mutex);
+}
@@ -0,0 +1,333 @@
+/**
+ * @file api_response_compress.c
+ * @brief Compression of API and playlist responses
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "web/api_response_compress.h"
+#include "core/config.h"
+#include "core/logger.h"
+#include "mongoose.h"
+
+// Low levels get most of the gain on JSON for a fraction of the CPU time
+#define API_COMPRESS_LEVEL 4
+
+// Largest chunk of a compressed chunked body
+#define API_COMPRESS_CHUNK_SIZE 16384
+
+bool http_accepts_encoding(struct mg_http_message *hm, const char *coding) {
+    struct mg_str *header = mg_http_get_header(hm, "Accept-Encoding");
+    if (!header) {
+        return false;
+    }
+
+    size_t coding_len = strlen(coding);
+    const char *p = header->buf;
+    const char *end = header->buf + header->len;
+    while (p < end) {
+        while (p < end && (*p == ' ' || *p == ',')) {
+            p++;
+        }
+        const char *token = p;
+        while (p < end && *p != ',' && *p != ';' && *p != ' ') {
+            p++;
+        }
+        bool match = (size_t)(p - token) == coding_len && strncasecmp(token, coding, coding_len) == 0;
+
+        const char *params = p;
+        while (p < end && *p != ',') {
+            p++;
+        }
+
+        if (match) {
+            char buf[64];
+            size_t len = (size_t)(p - params) < sizeof(buf) - 1 ? (size_t)(p - params) : sizeof(buf) - 1;
+            memcpy(buf, params, len);
+            buf[len] = '\0';
+            const char *q = strstr(buf, "q=");
+            return !q || atof(q + 2) > 0;
+        }
+    }
+    return false;
+}
+
+api_encoding_t api_response_encoding(struct mg_http_message *hm) {
+#ifdef HAVE_ZLIB
+    if (!g_config.web_compression_enabled || mg_strcmp(hm->method, mg_str("HEAD")) == 0) {
+        return API_ENCODING_IDENTITY;
+    }
+    if (http_accepts_encoding(hm, "gzip")) {
+        return API_ENCODING_GZIP;
+    }
+    if (http_accepts_encoding(hm, "deflate")) {
+        return API_ENCODING_DEFLATE;
+    }
+#else
+    (void)hm;
+#endif
+    return API_ENCODING_IDENTITY;
+}
+
+unsigned char *http_dechunk(const char *data, size_t size, size_t *out_len) {
+    unsigned char *out = malloc(size > 0 ? size : 1);
+    if (!out) {
+        return NULL;
+    }
+
+    size_t pos = 0;
+    size_t len = 0;
+    for (;;) {
+        size_t chunk = 0;
+        size_t digits = 0;
+        while (pos < size) {
+            char ch = data[pos];
+            int v = ch >= '0' && ch <= '9' ? ch - '0' :
+                    ch >= 'a' && ch <= 'f' ? ch - 'a' + 10 :
+                    ch >= 'A' && ch <= 'F' ? ch - 'A' + 10 : -1;
+            if (v < 0) {
+                break;
+            }
+            chunk = chunk * 16 + (size_t)v;
+            digits++;
+            pos++;
+        }
+        if (digits == 0 || digits > 8 || pos + 2 > size || memcmp(data + pos, "\r\n", 2) != 0) {
+            break;
+        }
+        pos += 2;
+
+        if (chunk == 0) {
+            // The last chunk, without trailers
+            if (pos + 2 == size && memcmp(data + pos, "\r\n", 2) == 0) {
+                *out_len = len;
+                return out;
+            }
+            break;
+        }
+        if (chunk > size - pos || size - pos - chunk < 2 || memcmp(data + pos + chunk, "\r\n", 2) != 0) {
+            break;
+        }
+        memcpy(out + len, data + pos, chunk);
+        len += chunk;
+        pos += chunk + 2;
+    }
+
+    free(out);
+    return NULL;
+}
+
+#ifdef HAVE_ZLIB
+
+/**
+ * Find a header in a terminated copy of the headers
+ *
+ * @return Start of the value, or NULL if missing
+ */
+static const char *find_header(const char *headers, const char *name) {
+    size_t name_len = strlen(name);
+    for (const char *line = strstr(headers, "\r\n"); line; line = strstr(line + 2, "\r\n")) {
+        if (strncasecmp(line + 2, name, name_len) == 0 && line[2 + name_len] == ':') {
+            const char *value = line + 3 + name_len;
+            while (*value == ' ') {
+                value++;
+            }
+            return value;
+        }
+    }
+    return NULL;
+}
+
+// Whether a header value, up to the end of its line, starts with a prefix
+static bool value_starts_with(const char *value, const char *prefix) {
+    return value && strncasecmp(value, prefix, strlen(prefix)) == 0;
+}
+
+static bool compressible_type(const char *headers) {
+    const char *type = find_header(headers, "Content-Type");
+    return value_starts_with(type, "application/json") || value_starts_with(type, "text/") ||
+           value_starts_with(type, "application/vnd.apple.mpegurl") ||
+           value_starts_with(type, "application/x-mpegurl");
+}
+
+static unsigned char *deflate_body(const unsigned char *body, size_t len, api_encoding_t encoding,
+                                   size_t *out_len) {
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    // 15 + 16: gzip wrapper; HTTP deflate is the zlib wrapper
+    int window_bits = encoding == API_ENCODING_GZIP ? 15 + 16 : 15;
+    if (deflateInit2(&zs, API_COMPRESS_LEVEL, Z_DEFLATED, window_bits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return NULL;
+    }
+
+    uLong bound = deflateBound(&zs, (uLong)len);
+    unsigned char *out = malloc(bound);
+    if (!out) {
+        deflateEnd(&zs);
+        return NULL;
+    }
+
+    zs.next_in = (Bytef *)body;
+    zs.avail_in = (uInt)len;
+    zs.next_out = out;
+    zs.avail_out = (uInt)bound;
+    int rc = deflate(&zs, Z_FINISH);
+    *out_len = zs.total_out;
+    deflateEnd(&zs);
+
+    if (rc != Z_STREAM_END) {
+        free(out);
+        return NULL;
+    }
+    return out;
+}
+
+/**
+ * Build the compressed response: the headers without those of the body,
+ * then the compressed body, as chunks if the response was chunked
+ */
+static char *build_response(const char *headers, bool chunked, api_encoding_t encoding,
+                            const unsigned char *body, size_t len, size_t *out_len) {
+    size_t headers_len = strlen(headers);
+    size_t chunks = (len + API_COMPRESS_CHUNK_SIZE - 1) / API_COMPRESS_CHUNK_SIZE;
+    size_t size = headers_len + 128 + len + chunks * 16 + 8;
+    char *out = malloc(size);
+    if (!out) {
+        return NULL;
+    }
+
+    // Status line
+    const char *line_end = strstr(headers, "\r\n");
+    size_t pos = (size_t)(line_end - headers);
+    memcpy(out, headers, pos);
+
+    for (const char *line = line_end; line; ) {
+        const char *next = strstr(line + 2, "\r\n");
+        size_t line_len = next ? (size_t)(next - line) : strlen(line);
+        if (strncasecmp(line + 2, "Content-Length:", 15) != 0 &&
+            strncasecmp(line + 2, "Transfer-Encoding:", 18) != 0) {
+            memcpy(out + pos, line, line_len);
+            pos += line_len;
+        }
+        line = next;
+    }
+
+    pos += (size_t)snprintf(out + pos, size - pos, "\r\nContent-Encoding: %s\r\nVary: Accept-Encoding\r\n",
+                            encoding == API_ENCODING_GZIP ? "gzip" : "deflate");
+    if (!chunked) {
+        pos += (size_t)snprintf(out + pos, size - pos, "Content-Length: %lu\r\n\r\n", (unsigned long)len);
+        memcpy(out + pos, body, len);
+        *out_len = pos + len;
+        return out;
+    }
+
+    pos += (size_t)snprintf(out + pos, size - pos, "Transfer-Encoding: chunked\r\n\r\n");
+    for (size_t done = 0; done < len; ) {
+        size_t n = len - done < API_COMPRESS_CHUNK_SIZE ? len - done : API_COMPRESS_CHUNK_SIZE;
+        pos += (size_t)snprintf(out + pos, size - pos, "%lx\r\n", (unsigned long)n);
+        memcpy(out + pos, body + done, n);
+        pos += n;
+        memcpy(out + pos, "\r\n", 2);
+        pos += 2;
+        done += n;
+    }
+    memcpy(out + pos, "0\r\n\r\n", 5);
+    *out_len = pos + 5;
+    return out;
+}
+
+void api_compress_response(struct mg_connection *c, api_encoding_t encoding, size_t start) {
+    if (encoding == API_ENCODING_IDENTITY || c->send.len <= start) {
+        return;
+    }
+
+    const char *data = (const char *)c->send.buf + start;
+    size_t size = c->send.len - start;
+    if (size < 13 || memcmp(data, "HTTP/1.1 200 ", 13) != 0) {
+        return;
+    }
+    const char *head_end = memmem(data, size, "\r\n\r\n", 4);
+    if (!head_end) {
+        return;
+    }
+
+    // Work on a terminated copy of the headers
+    size_t head_len = (size_t)(head_end - data);
+    char *headers = malloc(head_len + 1);
+    if (!headers) {
+        return;
+    }
+    memcpy(headers, data, head_len);
+    headers[head_len] = '\0';
+
+    const char *body = head_end + 4;
+    size_t body_size = size - head_len - 4;
+    if (!compressible_type(headers) || find_header(headers, "Content-Encoding") ||
+        find_header(headers, "Content-Range")) {
+        free(headers);
+        return;
+    }
+
+    // Only complete bodies: Content-Length bytes, or chunks up to the last
+    bool chunked = value_starts_with(find_header(headers, "Transfer-Encoding"), "chunked");
+    unsigned char *joined = NULL;
+    const unsigned char *raw = (const unsigned char *)body;
+    size_t raw_len = body_size;
+    if (chunked) {
+        joined = http_dechunk(body, body_size, &raw_len);
+        raw = joined;
+    } else {
+        const char *length = find_header(headers, "Content-Length");
+        if (!length || strtoul(length, NULL, 10) != body_size) {
+            raw = NULL;
+        }
+    }
+    if (!raw || raw_len < API_COMPRESS_MIN_SIZE) {
+        free(joined);
+        free(headers);
+        return;
+    }
+
+    size_t packed_len = 0;
+    unsigned char *packed = deflate_body(raw, raw_len, encoding, &packed_len);
+    free(joined);
+    if (!packed || packed_len >= raw_len) {
+        free(packed);
+        free(headers);
+        return;
+    }
+
+    size_t out_len = 0;
+    char *out = build_response(headers, chunked, encoding, packed, packed_len, &out_len);
+    free(packed);
+    free(headers);
+    if (!out) {
+        return;
+    }
+
+    log_debug("Compressed API response from %zu to %zu bytes", raw_len, packed_len);
+
+    // Replace what the handler wrote
+    c->send.len = start;
+    mg_send(c, out, out_len);
+    free(out);
+}
+
+#else
+
+void api_compress_response(struct mg_connection *c, api_encoding_t encoding, size_t start) {
+    (void)c;
+    (void)encoding;
+    (void)start;
+}
+
+#endif
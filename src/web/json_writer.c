@@ -0,0 +1,173 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "web/json_writer.h"
+#include "mongoose.h"
+
+/**
+ * Write the collected bytes to the connection as one chunk
+ */
+static void flush_chunk(json_writer_t *w) {
+    if (w->len > 0) {
+        mg_http_write_chunk(w->c, w->buf, w->len);
+        w->len = 0;
+    }
+}
+
+static void put(json_writer_t *w, const char *data, size_t len) {
+    while (len > 0) {
+        size_t space = sizeof(w->buf) - w->len;
+        if (space == 0) {
+            flush_chunk(w);
+            space = sizeof(w->buf);
+        }
+        size_t n = len < space ? len : space;
+        memcpy(w->buf + w->len, data, n);
+        w->len += n;
+        data += n;
+        len -= n;
+    }
+}
+
+static void put_char(json_writer_t *w, char ch) {
+    if (w->len == sizeof(w->buf)) {
+        flush_chunk(w);
+    }
+    w->buf[w->len++] = ch;
+}
+
+static void put_quoted(json_writer_t *w, const char *s) {
+    put_char(w, '"');
+    for (const unsigned char *p = (const unsigned char *)(s ? s : ""); *p; p++) {
+        switch (*p) {
+            case '"':  put(w, "\\\"", 2); break;
+            case '\\': put(w, "\\\\", 2); break;
+            case '\b': put(w, "\\b", 2); break;
+            case '\f': put(w, "\\f", 2); break;
+            case '\n': put(w, "\\n", 2); break;
+            case '\r': put(w, "\\r", 2); break;
+            case '\t': put(w, "\\t", 2); break;
+            default:
+                if (*p < 0x20) {
+                    char esc[8];
+                    snprintf(esc, sizeof(esc), "\\u%04x", *p);
+                    put(w, esc, 6);
+                } else {
+                    put_char(w, (char)*p);
+                }
+                break;
+        }
+    }
+    put_char(w, '"');
+}
+
+/**
+ * Write the separator and key that go before a value
+ */
+static void put_key(json_writer_t *w, const char *key) {
+    if (w->depth > 0 && w->depth <= JSON_WRITER_MAX_DEPTH) {
+        if (w->has_items[w->depth - 1]) {
+            put_char(w, ',');
+        }
+        w->has_items[w->depth - 1] = true;
+    }
+    if (key) {
+        put_quoted(w, key);
+        put_char(w, ':');
+    }
+}
+
+static void open_level(json_writer_t *w, const char *key, char bracket) {
+    put_key(w, key);
+    put_char(w, bracket);
+    if (w->depth < JSON_WRITER_MAX_DEPTH) {
+        w->has_items[w->depth] = false;
+    }
+    w->depth++;
+}
+
+static void close_level(json_writer_t *w, char bracket) {
+    if (w->depth > 0) {
+        w->depth--;
+    }
+    put_char(w, bracket);
+}
+
+void json_writer_begin(json_writer_t *w, struct mg_connection *c, int status_code) {
+    w->c = c;
+    w->len = 0;
+    w->depth = 0;
+
+    // Same headers as mg_send_json_response, with a chunked body
+    mg_printf(c, "HTTP/1.1 %d %s\r\n"
+                 "Content-Type: application/json\r\n"
+                 "Transfer-Encoding: chunked\r\n"
+                 "Connection: close\r\n"
+                 "Access-Control-Allow-Origin: *\r\n"
+                 "Access-Control-Allow-Methods: GET, POST, PUT, DELETE, OPTIONS\r\n"
+                 "Access-Control-Allow-Headers: Content-Type, Authorization, X-Requested-With\r\n"
+                 "Access-Control-Allow-Credentials: true\r\n"
+                 "Access-Control-Max-Age: 86400\r\n"
+                 "Cache-Control: no-cache, no-store, must-revalidate\r\n"
+                 "Pragma: no-cache\r\n"
+                 "Expires: 0\r\n"
+                 "\r\n",
+              status_code, status_code == 200 ? "OK" : "Error");
+}
+
+void json_writer_end(json_writer_t *w) {
+    flush_chunk(w);
+    mg_http_write_chunk(w->c, "", 0);
+}
+
+void json_write_object_start(json_writer_t *w, const char *key) {
+    open_level(w, key, '{');
+}
+
+void json_write_object_end(json_writer_t *w) {
+    close_level(w, '}');
+}
+
+void json_write_array_start(json_writer_t *w, const char *key) {
+    open_level(w, key, '[');
+}
+
+void json_write_array_end(json_writer_t *w) {
+    close_level(w, ']');
+}
+
+void json_write_string(json_writer_t *w, const char *key, const char *value) {
+    put_key(w, key);
+    put_quoted(w, value);
+}
+
+void json_write_number(json_writer_t *w, const char *key, double value) {
+    put_key(w, key);
+
+    // Like cJSON: whole numbers without a fraction, no NaN or infinity
+    char num[32];
+    int n;
+    if (!isfinite(value)) {
+        n = snprintf(num, sizeof(num), "null");
+    } else if (fabs(value) < 1e15 && value == (double)(long long)value) {
+        n = snprintf(num, sizeof(num), "%lld", (long long)value);
+    } else {
+        n = snprintf(num, sizeof(num), "%.15g", value);
+    }
+    put(w, num, (size_t)n);
+}
+
+void json_write_bool(json_writer_t *w, const char *key, bool value) {
+    put_key(w, key);
+    if (value) {
+        put(w, "true", 4);
+    } else {
+        put(w, "false", 5);
+    }
+}
+
+void json_write_null(json_writer_t *w, const char *key) {
+    put_key(w, key);
+    put(w, "null", 4);
+}
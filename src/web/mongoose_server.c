@@ -6,6 +6,10 @@
 #include <signal.h>
 #include <unistd.h>
 #include <regex.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
 
 #ifndef MIN
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
@@ -14,11 +18,18 @@
 #include "web/mongoose_server.h"
 #include "web/http_server.h"
 #include "core/logger.h"
+#include "core/config.h"
 #include "core/shutdown_coordinator.h"
+#include "core/metrics.h"
 #include "utils/memory.h"
 #include "web/mongoose_server_websocket.h"
 #include "web/websocket_manager.h"
 #include "web/mongoose_server_multithreading.h"
+#include "web/mongoose_server_sendfile.h"
+#include "web/mongoose_server_tls.h"
+#include "web/mongoose_server_limits.h"
+#include "web/mongoose_server_static_cache.h"
+#include "web/api_response_cache.h"
 #include "web/api_handlers_health.h"
 
 // Include Mongoose
@@ -27,15 +38,27 @@
 #include "web/api_handlers.h"
 #include "web/api_handlers_onvif.h"
 #include "web/api_handlers_timeline.h"
+#include "web/api_handlers_export.h"
 #include "web/api_handlers_recordings.h"
 #include "web/api_handlers_go2rtc_proxy.h"
+#include "web/api_handlers_federation.h"
 #include "web/api_handlers_users.h"
 #include "web/api_handlers_health.h"
+#include "web/api_handlers_metrics.h"
+#include "web/api_handlers_snapshot.h"
+#include "web/api_handlers_mjpeg.h"
+#include "web/api_handlers_recordings_thumbnails.h"
+#include "web/api_handlers_recordings_vod.h"
+#include "web/system_stats.h"
+#include "web/api_handlers_streams_ws.h"
+#include "web/api_response_compress.h"
 
 // Forward declarations for timeline API handlers
 void mg_handle_get_timeline_segments(struct mg_connection *c, struct mg_http_message *hm);
 void mg_handle_timeline_manifest(struct mg_connection *c, struct mg_http_message *hm);
 void mg_handle_timeline_playback(struct mg_connection *c, struct mg_http_message *hm);
+void mg_handle_get_timeline_activity(struct mg_connection *c, struct mg_http_message *hm);
+void mg_handle_get_timeline_segments_batch(struct mg_connection *c, struct mg_http_message *hm);
 
 // Forward declarations for HLS API handlers
 void mg_handle_hls_master_playlist(struct mg_connection *c, struct mg_http_message *hm);
@@ -55,6 +78,7 @@ typedef struct {
     const char *uri;        // URI pattern
     mg_api_handler_t handler; // Handler function
     bool no_auto_threading;  // If true, don't automatically thread this handler
+    unsigned int cache;      // API_CACHE_* flags of what the response shows, 0 if not cached
 } mg_api_route_t;
 
 // Forward declarations
@@ -70,6 +94,7 @@ static int match_route(struct mg_http_message *hm);
 #include "web/mongoose_server_auth.h"
 #include "web/mongoose_server_static.h"
 #include "web/http_router.h"
+#include "video/thread_utils.h"
 
 // Forward declarations for WebSocket handlers
 void mg_handle_batch_delete_recordings_ws(struct mg_connection *c, struct mg_http_message *hm);
@@ -77,6 +102,11 @@ void mg_handle_websocket_message(struct mg_connection *c, struct mg_ws_message *
 void mg_handle_websocket_close(struct mg_connection *c);
 
 
+// Data shown by the cached routes
+#define CACHE_STREAMS (API_CACHE_TABLE(DB_TABLE_STREAMS) | API_CACHE_STREAM_STATE)
+#define CACHE_RECORDINGS (API_CACHE_TABLE(DB_TABLE_RECORDINGS) | API_CACHE_TABLE(DB_TABLE_DETECTIONS))
+#define CACHE_DETECTIONS (API_CACHE_TABLE(DB_TABLE_DETECTIONS) | API_CACHE_CLOCK)
+
 // API routes table
 static const mg_api_route_t s_api_routes[] = {
     // Auth API
@@ -93,15 +123,17 @@ static const mg_api_route_t s_api_routes[] = {
     {"POST", "/api/auth/users/#/api-key", mg_handle_users_generate_api_key, true},  // Already uses threading
 
     // Streams API
-    {"GET", "/api/streams", mg_handle_get_streams, true},  // Opt out of auto-threading to prevent double threading
+    {"GET", "/api/streams", mg_handle_get_streams, true, CACHE_STREAMS},  // Opt out of auto-threading to prevent double threading
     {"POST", "/api/streams", mg_handle_post_stream, false},
     {"POST", "/api/streams/test", mg_handle_test_stream, false},
-    {"GET", "/api/streams/#", mg_handle_get_stream, true},  // Opt out of auto-threading to prevent double threading
+    {"GET", "/api/streams/#/snapshot.jpg", mg_handle_get_stream_snapshot, false},
+    {"GET", "/api/streams/#/mjpeg", mg_handle_get_stream_mjpeg, true},  // Streams the response from the event loop
+    {"GET", "/api/streams/#", mg_handle_get_stream, true, CACHE_STREAMS},  // Opt out of auto-threading to prevent double threading
     {"PUT", "/api/streams/#", mg_handle_put_stream, false},
     {"DELETE", "/api/streams/#", mg_handle_delete_stream, false},
 
     // Settings API
-    {"GET", "/api/settings", mg_handle_get_settings, false},
+    {"GET", "/api/settings", mg_handle_get_settings, false, API_CACHE_SETTINGS},
     {"POST", "/api/settings", mg_handle_post_settings, false},
 
     // System API
@@ -113,16 +145,30 @@ static const mg_api_route_t s_api_routes[] = {
     {"POST", "/api/system/logs/clear", mg_handle_post_system_logs_clear, false},
     {"POST", "/api/system/backup", mg_handle_post_system_backup, false},
     {"GET", "/api/system/status", mg_handle_get_system_status, false},
+    {"GET", "/api/system/load-shedding", mg_handle_get_load_shedding, false},
+    {"GET", "/api/system/device-profile", mg_handle_get_device_profile, false},
+    {"GET", "/api/system/startup", mg_handle_get_stream_startup, false},
+    {"GET", "/api/system/memory", mg_handle_get_memory_usage, false},
+    {"GET", "/api/system/database/integrity", mg_handle_get_database_integrity, false},
+    {"POST", "/api/system/database/backup", mg_handle_post_database_backup, false},
+    {"GET", "/api/system/database/backup", mg_handle_get_database_backup, false},
+    {"GET", "/api/system/threads", mg_handle_get_thread_usage, false},
+    {"GET", "/api/system/trace", mg_handle_get_pipeline_trace, false},
+    {"POST", "/api/system/trace", mg_handle_post_pipeline_trace, false},
+    {"GET", "/api/system/profile", mg_handle_get_profile, true},  // Already uses threading
     {"GET", "/api/health", mg_handle_get_health, false},
     {"GET", "/api/health/hls", mg_handle_get_hls_health, false},
 
     // Recordings API
-    {"GET", "/api/recordings", mg_handle_get_recordings, false},
+    {"GET", "/api/recordings", mg_handle_get_recordings, false, CACHE_RECORDINGS},
     {"GET", "/api/recordings/play/#", mg_handle_play_recording, true},  // Opt out of auto-threading to prevent hanging
     {"GET", "/api/recordings/download/#", mg_handle_download_recording, true},  // Opt out of auto-threading to prevent hanging
+    {"GET", "/api/recordings/thumbnail/#", mg_handle_get_recording_thumbnail, true},  // Serves the file from the event loop
+    {"GET", "/api/recordings/sprite/#", mg_handle_get_recording_sprite, true},  // Serves the file from the event loop
+    {"GET", "/api/recordings/vod/#/#", mg_handle_get_recording_vod, false},
     {"GET", "/api/recordings/files/check", mg_handle_check_recording_file, true},  // Already uses threading
     {"DELETE", "/api/recordings/files", mg_handle_delete_recording_file, true},  // Already uses threading
-    {"GET", "/api/recordings/#", mg_handle_get_recording, false},
+    {"GET", "/api/recordings/#", mg_handle_get_recording, false, CACHE_RECORDINGS},
     {"DELETE", "/api/recordings/#", mg_handle_delete_recording, true},  // Already uses threading
     {"POST", "/api/recordings/batch-delete", mg_handle_batch_delete_recordings, true},  // Already uses threading
     {"POST", "/api/recordings/batch-delete-ws", mg_handle_batch_delete_recordings_ws, false},  // Already uses threading
@@ -137,8 +183,13 @@ static const mg_api_route_t s_api_routes[] = {
     {"OPTIONS", "/api/webrtc/ice", mg_handle_go2rtc_webrtc_ice_options, false},  // OPTIONS requests are fast, no need for threading
 
     // Detection API
-    {"GET", "/api/detection/results/#", mg_handle_get_detection_results, true},  // Opt out of auto-threading to prevent double threading
+    {"GET", "/api/detection/results/#", mg_handle_get_detection_results, true, CACHE_DETECTIONS},  // Opt out of auto-threading to prevent double threading
+    {"POST", "/api/detection/results/#", mg_handle_post_detection_results, false},
+    {"GET", "/api/detection/search", mg_handle_get_detection_search, false, CACHE_DETECTIONS},
     {"GET", "/api/detection/models", mg_handle_get_detection_models, false},
+    {"GET", "/api/detection/replay", mg_handle_get_detection_replay, false},
+    {"POST", "/api/detection/replay", mg_handle_post_detection_replay, false},
+    {"DELETE", "/api/detection/replay", mg_handle_delete_detection_replay, false},
 
     // ONVIF API
     {"GET", "/api/onvif/discovery/status", mg_handle_get_onvif_discovery_status, false},
@@ -150,13 +201,45 @@ static const mg_api_route_t s_api_routes[] = {
 
     // Timeline API
     {"GET", "/api/timeline/segments", mg_handle_get_timeline_segments, true},  // Opt out of auto-threading to prevent hanging
-    {"GET", "/api/timeline/manifest", mg_handle_timeline_manifest, true},
+    {"GET", "/api/timeline/segments/batch", mg_handle_get_timeline_segments_batch, false, CACHE_RECORDINGS},
+    {"GET", "/api/timeline/manifest", mg_handle_timeline_manifest, false},  // Reads keyframe indexes
     {"GET", "/api/timeline/play", mg_handle_timeline_playback, false},
+    {"GET", "/api/timeline/activity", mg_handle_get_timeline_activity, false, CACHE_DETECTIONS},
+
+    // Export API
+    {"GET", "/api/export", mg_handle_export_clip, true},  // Streams the response from the event loop
+
+    // Federation API, waits for the peers in a worker thread
+    {"GET", "/api/federation/nodes", mg_handle_get_federation_nodes, false},
+    {"GET", "/api/federation/streams", mg_handle_get_federation_streams, false},
+    {"GET", "/api/federation/recordings", mg_handle_get_federation_recordings, false},
+    {"GET", "/api/federation/detection/search", mg_handle_get_federation_detection_search, false},
+    {"GET", "/api/federation/timeline/segments", mg_handle_get_federation_timeline_segments, false},
+    {"GET", "/api/federation/node/#", mg_handle_federation_node_redirect, true},  // Only redirects
+    {"POST", "/api/federation/node/#", mg_handle_federation_node_redirect, true},  // Only redirects
 
     // End of table marker
     {NULL, NULL, NULL, false}
 };
 
+// Request latency histogram of each route, registered on first use
+static metric_t s_route_metrics[sizeof(s_api_routes) / sizeof(s_api_routes[0])];
+
+/**
+ * @brief Get the request latency histogram of a route
+ */
+static metric_t route_metric(int route_index) {
+    metric_t metric = __atomic_load_n(&s_route_metrics[route_index], __ATOMIC_RELAXED);
+    if (!metric) {
+        metric = metrics_histogram("lightnvr_http_request_seconds",
+                                   "Time to handle an API request, including the wait for a worker",
+                                   "method", s_api_routes[route_index].method,
+                                   "route", s_api_routes[route_index].uri, NULL);
+        __atomic_store_n(&s_route_metrics[route_index], metric, __ATOMIC_RELAXED);
+    }
+    return metric;
+}
+
 /**
  * @brief Handle API request using the routes table
  *
@@ -186,36 +269,23 @@ static bool handle_api_request(struct mg_connection *c, struct mg_http_message *
         // Route matched
         log_info("API route matched: %s %s", method_buf, uri_buf);
 
+        // Data that has not changed is answered without running the handler
+        api_cache_ctx_t cache;
+        if (api_cache_lookup(c, hm, s_api_routes[route_index].cache, &cache)) {
+            log_debug("API request answered from cache: %s %s", method_buf, uri_buf);
+            return true;
+        }
+
         // Check if this handler should be automatically threaded
         if (use_threading && !s_api_routes[route_index].no_auto_threading) {
             // Handle in a separate thread using mg_thread_function
             log_info("Handling API request in a worker thread: %s %s", method_buf, uri_buf);
 
-            // Create a thread data structure
-            struct mg_thread_data *data = calloc(1, sizeof(struct mg_thread_data));
-            if (!data) {
-                log_error("Failed to allocate memory for thread data");
-                mg_http_reply(c, 500, "", "Internal Server Error\n");
+            // Queue for a worker thread; errors have been answered already
+            if (!mg_offload_route(c, hm, s_api_routes[route_index].handler, route_metric(route_index), &cache)) {
                 return true;
             }
 
-            // Copy the HTTP message
-            data->message = mg_strdup(hm->message);
-            if (data->message.len == 0) {
-                log_error("Failed to duplicate HTTP message");
-                free(data);
-                mg_http_reply(c, 500, "", "Internal Server Error\n");
-                return true;
-            }
-
-            // Set connection ID, manager, and handler function
-            data->conn_id = c->id;
-            data->mgr = c->mgr;
-            data->handler_func = s_api_routes[route_index].handler;
-
-            // Start thread
-            mg_start_thread(mg_thread_function, data);
-
             log_info("API request started in a worker thread: %s %s", method_buf, uri_buf);
             return true;
         } else {
@@ -225,7 +295,12 @@ static bool handle_api_request(struct mg_connection *c, struct mg_http_message *
             }
             // Call handler directly
             log_info("Handling API request directly: %s %s", method_buf, uri_buf);
+            uint64_t started_us = metrics_now_us();
+            size_t start = c->send.len;
             s_api_routes[route_index].handler(c, hm);
+            api_compress_response(c, api_response_encoding(hm), start);
+            api_cache_store(&cache, c, start);
+            metrics_observe_since(route_metric(route_index), started_us);
             return true;
         }
     }
@@ -235,22 +310,183 @@ static bool handle_api_request(struct mg_connection *c, struct mg_http_message *
     return false;
 }
 
+/*
+ * Routes are compiled into a trie of path segments when the server starts,
+ * so matching walks the request path once instead of trying every pattern.
+ * A "#" segment matches one path segment, or everything that remains when it
+ * ends the pattern, as it does for mg_match(). Literal segments win over
+ * "#", and among routes with the same method and pattern the first in
+ * s_api_routes wins.
+ */
+
+// Most trie nodes; each distinct pattern prefix takes one
+#define ROUTE_TRIE_MAX_NODES 256
+
+#define ROUTE_COUNT (sizeof(s_api_routes) / sizeof(s_api_routes[0]))
+
+typedef struct {
+    const char *segment;    // Literal segment, NULL for "#"
+    size_t segment_len;
+    int first_child;        // Index of first child, -1 if none
+    int next_sibling;       // Index of next sibling, -1 if none
+    int param_child;        // Child for a "#" followed by more segments, -1 if none
+    int rest_routes;        // First route ending in "#" here, -1 if none
+    int routes;             // First route ending exactly here, -1 if none
+} route_node_t;
+
+static route_node_t s_route_nodes[ROUTE_TRIE_MAX_NODES];
+static int s_route_node_count = 0;
+
+// Next route on the same node, in table order, -1 at the end
+static int s_route_next[ROUTE_COUNT];
+
+static int route_node_new(const char *segment, size_t segment_len) {
+    if (s_route_node_count >= ROUTE_TRIE_MAX_NODES) {
+        return -1;
+    }
+    route_node_t *node = &s_route_nodes[s_route_node_count];
+    node->segment = segment;
+    node->segment_len = segment_len;
+    node->first_child = -1;
+    node->next_sibling = -1;
+    node->param_child = -1;
+    node->rest_routes = -1;
+    node->routes = -1;
+    return s_route_node_count++;
+}
+
+static int route_node_child(int parent, const char *segment, size_t segment_len) {
+    for (int i = s_route_nodes[parent].first_child; i >= 0; i = s_route_nodes[i].next_sibling) {
+        if (s_route_nodes[i].segment_len == segment_len &&
+            memcmp(s_route_nodes[i].segment, segment, segment_len) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Append a route to a node's list, keeping table order
+ */
+static void route_list_append(int *head, int route_index) {
+    while (*head >= 0) {
+        head = &s_route_next[*head];
+    }
+    *head = route_index;
+    s_route_next[route_index] = -1;
+}
+
+static bool route_trie_insert(int route_index) {
+    const char *p = s_api_routes[route_index].uri;
+    int node = 0;
+
+    // Patterns start with "/"; each following segment is one level
+    while (*p == '/') {
+        p++;
+        const char *end = strchr(p, '/');
+        size_t len = end ? (size_t)(end - p) : strlen(p);
+
+        if (len == 1 && *p == '#') {
+            if (!end) {
+                route_list_append(&s_route_nodes[node].rest_routes, route_index);
+                return true;
+            }
+            if (s_route_nodes[node].param_child < 0) {
+                int child = route_node_new(NULL, 0);
+                if (child < 0) {
+                    return false;
+                }
+                s_route_nodes[node].param_child = child;
+            }
+            node = s_route_nodes[node].param_child;
+        } else {
+            int child = route_node_child(node, p, len);
+            if (child < 0) {
+                child = route_node_new(p, len);
+                if (child < 0) {
+                    return false;
+                }
+                s_route_nodes[child].next_sibling = s_route_nodes[node].first_child;
+                s_route_nodes[node].first_child = child;
+            }
+            node = child;
+        }
+        p += len;
+    }
+
+    route_list_append(&s_route_nodes[node].routes, route_index);
+    return true;
+}
+
 /**
  * @brief Initialize the route table
  */
 static void init_route_table(void) {
-    // Nothing to initialize since we're using the static s_api_routes table
-    log_info("Route table initialized using API routes table");
+    s_route_node_count = 0;
+    route_node_new(NULL, 0);
+
+    for (int i = 0; s_api_routes[i].method != NULL; i++) {
+        if (!route_trie_insert(i)) {
+            log_error("Route table full, %s %s will not be served", s_api_routes[i].method, s_api_routes[i].uri);
+        }
+    }
+    log_info("Route table initialized: %d routes in %d nodes", (int)ROUTE_COUNT - 1, s_route_node_count);
 }
 
 /**
  * @brief Free the route table
  */
 static void free_route_table(void) {
-    // Nothing to free since we're using a static table
+    // The trie lives in static storage; dropping the nodes makes every lookup miss
+    s_route_node_count = 0;
     log_info("Route table reference cleared");
 }
 
+/**
+ * @brief First route in a node's list accepting the request method
+ */
+static int route_list_find(int head, struct mg_str method) {
+    for (int i = head; i >= 0; i = s_route_next[i]) {
+        if (strlen(s_api_routes[i].method) == method.len &&
+            memcmp(s_api_routes[i].method, method.buf, method.len) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Match the rest of a path below a trie node
+ *
+ * @param node Trie node reached so far
+ * @param p Remaining path, just past a "/"
+ * @param end End of the path
+ * @param method Request method
+ * @return Index of the matching route or -1
+ */
+static int route_trie_match(int node, const char *p, const char *end, struct mg_str method) {
+    const char *slash = memchr(p, '/', (size_t)(end - p));
+    const char *segment_end = slash ? slash : end;
+    size_t len = (size_t)(segment_end - p);
+    int route = -1;
+
+    // Literal segment first, then "#" as one segment, then "#" as the rest
+    int child = route_node_child(node, p, len);
+    if (child >= 0) {
+        route = slash ? route_trie_match(child, slash + 1, end, method)
+                      : route_list_find(s_route_nodes[child].routes, method);
+    }
+    if (route < 0 && s_route_nodes[node].param_child >= 0) {
+        int param = s_route_nodes[node].param_child;
+        route = slash ? route_trie_match(param, slash + 1, end, method)
+                      : route_list_find(s_route_nodes[param].routes, method);
+    }
+    if (route < 0) {
+        route = route_list_find(s_route_nodes[node].rest_routes, method);
+    }
+    return route;
+}
+
 /**
  * @brief Match a route in the route table
  *
@@ -258,33 +494,126 @@ static void free_route_table(void) {
  * @return int Index of matching route or -1 if no match
  */
 static int match_route(struct mg_http_message *hm) {
-    if (!hm) {
+    if (!hm || s_route_node_count == 0 || hm->uri.len == 0 || hm->uri.buf[0] != '/') {
         return -1;
     }
 
-    // Try to match each route
-    for (int i = 0; s_api_routes[i].method != NULL; i++) {
-        // Check method
-        if (!mg_match(hm->method, mg_str(s_api_routes[i].method), NULL)) {
-            continue;
+    int route = route_trie_match(0, hm->uri.buf + 1, hm->uri.buf + hm->uri.len, hm->method);
+    if (route >= 0) {
+        log_debug("Route matched: method=%.*s, pattern=%s, uri=%.*s",
+                 (int)hm->method.len, hm->method.buf,
+                 s_api_routes[route].uri,
+                 (int)hm->uri.len, hm->uri.buf);
+    } else {
+        log_debug("No route matched for: %.*s %.*s",
+                 (int)hm->method.len, hm->method.buf,
+                 (int)hm->uri.len, hm->uri.buf);
+    }
+    return route;
+}
+
+// Argument of each event loop thread
+typedef struct {
+    http_server_t *server;
+    struct mg_mgr *mgr;
+} event_loop_arg_t;
+
+static event_loop_arg_t s_event_loops[MAX_WEB_EVENT_LOOPS];
+
+/**
+ * @brief Free the event managers of all loops
+ */
+static void free_event_managers(http_server_t *server) {
+    for (int i = 0; i < MAX_WEB_EVENT_LOOPS; i++) {
+        if (server->loop_mgrs[i]) {
+            mg_mgr_free(server->loop_mgrs[i]);
+            free(server->loop_mgrs[i]);
+            server->loop_mgrs[i] = NULL;
         }
+    }
+    server->mgr = NULL;
+}
 
-        // Check if URI matches the pattern
-        if (mg_match(hm->uri, mg_str(s_api_routes[i].uri), NULL)) {
-            // Route matched
-            log_debug("Route matched: method=%.*s, pattern=%s, uri=%.*s",
-                     (int)hm->method.len, hm->method.buf,
-                     s_api_routes[i].uri,
-                     (int)hm->uri.len, hm->uri.buf);
-            return i;
+/**
+ * @brief Open a listening socket on the web port that other loops may share
+ *
+ * With SO_REUSEPORT every loop has its own socket on the same port and the
+ * kernel spreads incoming connections across them.
+ *
+ * @param port TCP port
+ * @return Socket descriptor, or -1 on failure
+ */
+static int open_reuseport_listener(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        log_error("Failed to create listening socket: %s", strerror(errno));
+        return -1;
+    }
+
+    int on = 1;
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) != 0 ||
+        setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) != 0 ||
+        bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(fd, SOMAXCONN) != 0) {
+        log_error("Failed to listen on port %d with SO_REUSEPORT: %s", port, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    return fd;
+}
+
+/**
+ * @brief Start listening on one event loop
+ *
+ * Mongoose has no option for SO_REUSEPORT, so with several loops each one
+ * listens on a throwaway loopback port and the descriptor is then replaced
+ * with a socket bound to the web port.
+ *
+ * @return Listening connection, or NULL on failure
+ */
+static struct mg_connection *listen_event_loop(http_server_t *server, struct mg_mgr *mgr) {
+    const char *scheme = server->config.ssl_enabled ? "https" : "http";
+    char listen_url[128];
+    struct mg_connection *c;
+
+    if (server->loop_count == 1) {
+        snprintf(listen_url, sizeof(listen_url), "%s://0.0.0.0:%d", scheme, server->config.port);
+        c = mg_http_listen(mgr, listen_url, mongoose_event_handler, server);
+        if (c == NULL) {
+            log_error("Failed to start server on %s", listen_url);
         }
+        return c;
     }
 
-    // No route matched
-    log_debug("No route matched for: %.*s %.*s",
-             (int)hm->method.len, hm->method.buf,
-             (int)hm->uri.len, hm->uri.buf);
-    return -1;
+    snprintf(listen_url, sizeof(listen_url), "%s://127.0.0.1:0", scheme);
+    c = mg_http_listen(mgr, listen_url, mongoose_event_handler, server);
+    if (c == NULL || c->fd == NULL) {
+        log_error("Failed to create listener for an event loop");
+        return NULL;
+    }
+
+    int fd = open_reuseport_listener(server->config.port);
+    if (fd < 0) {
+        c->is_closing = 1;
+        return NULL;
+    }
+    if (dup2(fd, (int)(size_t)c->fd) < 0) {
+        log_error("Failed to install listening socket: %s", strerror(errno));
+        close(fd);
+        c->is_closing = 1;
+        return NULL;
+    }
+    close(fd);
+    return c;
 }
 
 /**
@@ -306,35 +635,49 @@ http_server_handle_t mongoose_server_init(const http_server_config_t *config) {
     // Copy configuration
     memcpy(&server->config, config, sizeof(http_server_config_t));
 
-    // Allocate Mongoose event manager
-    server->mgr = calloc(1, sizeof(struct mg_mgr));
-    if (!server->mgr) {
-        log_error("Failed to allocate memory for Mongoose event manager");
-        free(server);
-        return NULL;
+    // One Mongoose event manager per event loop
+    server->loop_count = config->event_loops;
+    if (server->loop_count < 1) {
+        server->loop_count = 1;
+    } else if (server->loop_count > MAX_WEB_EVENT_LOOPS) {
+        server->loop_count = MAX_WEB_EVENT_LOOPS;
     }
+    for (int i = 0; i < server->loop_count; i++) {
+        server->loop_mgrs[i] = calloc(1, sizeof(struct mg_mgr));
+        if (!server->loop_mgrs[i]) {
+            log_error("Failed to allocate memory for Mongoose event manager");
+            free_event_managers(server);
+            free(server);
+            return NULL;
+        }
 
-    // Initialize Mongoose event manager
-    mg_mgr_init(server->mgr);
+        // Initialize Mongoose event manager
+        mg_mgr_init(server->loop_mgrs[i]);
 
-    // Initialize wakeup functionality for multithreading
-    mg_wakeup_init(server->mgr);
+        // Initialize wakeup functionality for multithreading
+        mg_wakeup_init(server->loop_mgrs[i]);
+    }
+    server->mgr = server->loop_mgrs[0];
 
     // Allocate handlers array
     server->handlers = calloc(INITIAL_HANDLER_CAPACITY, sizeof(*server->handlers));
     if (!server->handlers) {
         log_error("Failed to allocate memory for handlers");
-        mg_mgr_free(server->mgr);
-        free(server->mgr);
+        free_event_managers(server);
         free(server);
         return NULL;
     }
 
+    // Web interface files are served from memory
+    static_cache_init(server->config.web_root, g_config.web_compression_enabled);
+
+    // Compile the API routes for matching
+    init_route_table();
+
     // Register WebSocket handlers
     log_info("Registering WebSocket handlers");
     websocket_register_handlers();
 
-    log_info("Using per-request threading for all requests");
 
     server->handler_capacity = INITIAL_HANDLER_CAPACITY;
     server->handler_count = 0;
@@ -361,20 +704,36 @@ int http_server_start(http_server_handle_t server) {
         return 0;
     }
 
-    // Construct listen URL
-    char listen_url[128];
-    if (server->config.ssl_enabled) {
-        snprintf(listen_url, sizeof(listen_url), "https://0.0.0.0:%d", server->config.port);
-    } else {
-        snprintf(listen_url, sizeof(listen_url), "http://0.0.0.0:%d", server->config.port);
-    }
+    // Start listening on every event loop; with several, the ones that could
+    // not listen are dropped
+    int listening = 0;
+    struct mg_connection *c = NULL;
+    for (int i = 0; i < server->loop_count; i++) {
+        struct mg_connection *lc = listen_event_loop(server, server->loop_mgrs[i]);
+        if (!lc) {
+            break;
+        }
+        if (i == 0) {
+            c = lc;
+        }
 
-    // Start listening
-    struct mg_connection *c = mg_http_listen(server->mgr, listen_url, mongoose_event_handler, server);
-    if (c == NULL) {
-        log_error("Failed to start server on %s", listen_url);
+        // Configure SSL if enabled
+        if (server->config.ssl_enabled) {
+            struct mg_tls_opts opts = {
+                .cert = server->config.cert_path,
+                .key = server->config.key_path,
+            };
+            mg_tls_init(lc, &opts);
+        }
+        listening++;
+    }
+    if (listening == 0) {
         return -1;
     }
+    if (listening < server->loop_count) {
+        log_warn("Only %d of %d event loops are listening", listening, server->loop_count);
+        server->loop_count = listening;
+    }
 
     // Store the socket file descriptor for signal handling
     if (c->fd != NULL) {
@@ -391,32 +750,50 @@ int http_server_start(http_server_handle_t server) {
         }
     }
 
-    // Configure SSL if enabled
-    if (server->config.ssl_enabled) {
-        struct mg_tls_opts opts = {
-            .cert = server->config.cert_path,
-            .key = server->config.key_path,
-        };
-        mg_tls_init(c, &opts);
+    mg_limits_init(&server->config);
+
+    // Workers for requests handed off by the event loop
+    if (mg_worker_pool_start(server->config.worker_threads, server->config.request_queue_size,
+                             server->config.route_max_concurrency) != 0) {
+        log_error("Failed to start web worker threads");
+        return -1;
+    }
+
+    // Figures for /api/system/info are sampled in the background
+    if (system_stats_start() != 0) {
+        log_warn("System info will be empty without the stats sampler");
+    }
+    if (stream_status_publisher_start() != 0) {
+        log_warn("Stream status will not be pushed over WebSocket");
     }
 
     server->running = true;
-    log_info("HTTP server started on port %d", server->config.port);
+    log_info("HTTP server started on port %d with %d event loop(s)", server->config.port, server->loop_count);
 
-    // Create a thread that runs the event loop
-    pthread_t thread;
-    if (pthread_create(&thread, NULL, (void *(*)(void *))mongoose_server_event_loop, server) != 0) {
-        log_error("Failed to create server thread");
-        server->running = false;
-        return -1;
-    }
+    // Create a thread that runs each event loop
+    for (int i = 0; i < server->loop_count; i++) {
+        s_event_loops[i].server = server;
+        s_event_loops[i].mgr = server->loop_mgrs[i];
 
-    // Store the thread ID for health check monitoring
-    set_web_server_thread_id(thread);
-    log_info("Web server thread created with ID: %lu", (unsigned long)thread);
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, mongoose_server_event_loop, &s_event_loops[i]) != 0) {
+            log_error("Failed to create server thread");
+            server->running = false;
+            system_stats_stop();
+            stream_status_publisher_stop();
+            mg_worker_pool_stop();
+            return -1;
+        }
 
-    // Detach thread to let it run independently
-    pthread_detach(thread);
+        // Store the thread ID of the first loop for health check monitoring
+        if (i == 0) {
+            set_web_server_thread_id(thread);
+        }
+        log_info("Web server thread %d created with ID: %lu", i, (unsigned long)thread);
+
+        // Detach thread to let it run independently
+        pthread_detach(thread);
+    }
 
     return 0;
 }
@@ -439,13 +816,19 @@ void http_server_stop(http_server_handle_t server) {
     // Give WebSocket connections time to send close frames
     usleep(250000); // 250ms for WebSocket connections to close
 
-    // Store the listening socket FD before closing connections
-    int listening_socket_fd = -1;
-    for (struct mg_connection *c = server->mgr->conns; c != NULL; c = c->next) {
-        if (c->is_listening && c->fd != NULL) {
-            listening_socket_fd = (int)(size_t)c->fd;
-            log_info("Found listening socket: %d", listening_socket_fd);
-            break;
+    // Store the listening socket FDs of all loops before closing connections
+    int listening_socket_fds[MAX_WEB_EVENT_LOOPS];
+    int listening_socket_count = 0;
+    for (int i = 0; i < MAX_WEB_EVENT_LOOPS; i++) {
+        if (!server->loop_mgrs[i]) {
+            continue;
+        }
+        for (struct mg_connection *c = server->loop_mgrs[i]->conns; c != NULL; c = c->next) {
+            if (c->is_listening && c->fd != NULL) {
+                listening_socket_fds[listening_socket_count++] = (int)(size_t)c->fd;
+                log_info("Found listening socket: %d", (int)(size_t)c->fd);
+                break;
+            }
         }
     }
 
@@ -454,16 +837,21 @@ void http_server_stop(http_server_handle_t server) {
     struct mg_connection *next = NULL;
 
     // First pass: Mark all connections for closing and send close frames
-    for (struct mg_connection *c = server->mgr->conns; c != NULL; c = c->next) {
-        connection_count++;
+    for (int i = 0; i < MAX_WEB_EVENT_LOOPS; i++) {
+        if (!server->loop_mgrs[i]) {
+            continue;
+        }
+        for (struct mg_connection *c = server->loop_mgrs[i]->conns; c != NULL; c = c->next) {
+            connection_count++;
 
-        // Mark all connections for closing
-        c->is_closing = 1;
+            // Mark all connections for closing
+            c->is_closing = 1;
 
-        // Send proper close frame for WebSocket connections
-        if (c->is_websocket) {
-            mg_ws_send(c, "", 0, WEBSOCKET_OP_CLOSE);
-            log_debug("Sent WebSocket close frame to connection");
+            // Send proper close frame for WebSocket connections
+            if (c->is_websocket) {
+                mg_ws_send(c, "", 0, WEBSOCKET_OP_CLOSE);
+                log_debug("Sent WebSocket close frame to connection");
+            }
         }
     }
 
@@ -473,48 +861,66 @@ void http_server_stop(http_server_handle_t server) {
     usleep(100000); // 100ms
 
     // Second pass: Forcibly close all sockets
-    for (struct mg_connection *c = server->mgr->conns; c != NULL; c = next) {
-        // Save next pointer before potentially invalidating the current connection
-        next = c->next;
-
-        // Close the socket explicitly to ensure it's released
-        if (c->fd != NULL && !c->is_listening) { // Don't close listening socket yet
-            int socket_fd = (int)(size_t)c->fd;
-            log_debug("Forcibly closing socket: %d", socket_fd);
-
-            // Set SO_LINGER to force immediate socket closure
-            struct linger so_linger;
-            so_linger.l_onoff = 1;
-            so_linger.l_linger = 0;
-            setsockopt(socket_fd, SOL_SOCKET, SO_LINGER, &so_linger, sizeof(so_linger));
-
-            // Set socket to non-blocking mode to avoid hang on close
-            int flags = fcntl(socket_fd, F_GETFL, 0);
-            fcntl(socket_fd, F_SETFL, flags | O_NONBLOCK);
-
-            // Shutdown both directions of the socket
-            shutdown(socket_fd, SHUT_RDWR);
-
-            // Now close the socket
-            close(socket_fd);
-            c->fd = NULL;  // Mark as closed
-
-            // Force Mongoose to drop this connection
-            c->is_draining = 1;
-            c->is_closing = 1;
-            c->is_readable = 0;
-            c->is_writable = 0;
+    for (int i = 0; i < MAX_WEB_EVENT_LOOPS; i++) {
+        if (!server->loop_mgrs[i]) {
+            continue;
+        }
+        for (struct mg_connection *c = server->loop_mgrs[i]->conns; c != NULL; c = next) {
+            // Save next pointer before potentially invalidating the current connection
+            next = c->next;
+
+            // Close the socket explicitly to ensure it's released
+            if (c->fd != NULL && !c->is_listening) { // Don't close listening socket yet
+                int socket_fd = (int)(size_t)c->fd;
+                log_debug("Forcibly closing socket: %d", socket_fd);
+
+                // Set SO_LINGER to force immediate socket closure
+                struct linger so_linger;
+                so_linger.l_onoff = 1;
+                so_linger.l_linger = 0;
+                setsockopt(socket_fd, SOL_SOCKET, SO_LINGER, &so_linger, sizeof(so_linger));
+
+                // Set socket to non-blocking mode to avoid hang on close
+                int flags = fcntl(socket_fd, F_GETFL, 0);
+                fcntl(socket_fd, F_SETFL, flags | O_NONBLOCK);
+
+                // Shutdown both directions of the socket
+                shutdown(socket_fd, SHUT_RDWR);
+
+                // Now close the socket
+                close(socket_fd);
+                c->fd = NULL;  // Mark as closed
+
+                // Force Mongoose to drop this connection
+                c->is_draining = 1;
+                c->is_closing = 1;
+                c->is_readable = 0;
+                c->is_writable = 0;
+            }
         }
     }
 
     // Give a short time for the manager to process the closed connections
     usleep(250000); // 250ms
 
-    // Explicitly poll the manager one more time to process closed connections
-    mg_mgr_poll(server->mgr, 0);
+    // Explicitly poll the managers one more time to process closed connections
+    for (int i = 0; i < MAX_WEB_EVENT_LOOPS; i++) {
+        if (server->loop_mgrs[i]) {
+            mg_mgr_poll(server->loop_mgrs[i], 0);
+        }
+    }
 
-    // Free Mongoose event manager
-    mg_mgr_free(server->mgr);
+    // Let running requests finish while wakeups can still be delivered
+    mg_worker_pool_stop();
+    system_stats_stop();
+    stream_status_publisher_stop();
+
+    // Free Mongoose event managers
+    for (int i = 0; i < MAX_WEB_EVENT_LOOPS; i++) {
+        if (server->loop_mgrs[i]) {
+            mg_mgr_free(server->loop_mgrs[i]);
+        }
+    }
 
     // Reset the web server socket
     set_web_server_socket(-1);
@@ -522,22 +928,25 @@ void http_server_stop(http_server_handle_t server) {
     // Log the final state
     log_info("All Mongoose connections closed and manager freed");
 
-    // Now explicitly close the listening socket if we found it
-    if (listening_socket_fd >= 0) {
-        log_info("Explicitly closing listening socket: %d", listening_socket_fd);
+    // Now explicitly close the listening sockets if we found them
+    if (listening_socket_count > 0) {
+        for (int i = 0; i < listening_socket_count; i++) {
+            int listening_socket_fd = listening_socket_fds[i];
+            log_info("Explicitly closing listening socket: %d", listening_socket_fd);
 
-        // Force immediate closure with SO_LINGER
-        struct linger so_linger;
-        so_linger.l_onoff = 1;
-        so_linger.l_linger = 0;
-        setsockopt(listening_socket_fd, SOL_SOCKET, SO_LINGER, &so_linger, sizeof(so_linger));
+            // Force immediate closure with SO_LINGER
+            struct linger so_linger;
+            so_linger.l_onoff = 1;
+            so_linger.l_linger = 0;
+            setsockopt(listening_socket_fd, SOL_SOCKET, SO_LINGER, &so_linger, sizeof(so_linger));
 
-        // Also set SO_REUSEADDR to allow immediate reuse of the port
-        int reuse = 1;
-        setsockopt(listening_socket_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+            // Also set SO_REUSEADDR to allow immediate reuse of the port
+            int reuse = 1;
+            setsockopt(listening_socket_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
 
-        // Close the socket
-        close(listening_socket_fd);
+            // Close the socket
+            close(listening_socket_fd);
+        }
 
         // Double-check that the port is released by trying to bind to it
         int test_socket = socket(AF_INET, SOCK_STREAM, 0);
@@ -585,8 +994,13 @@ void http_server_destroy(http_server_handle_t server) {
 
     // First, mark all connections as closing to prevent new operations
     log_info("Marking all connections for closing");
-    for (struct mg_connection *c = server->mgr->conns; c != NULL; c = c->next) {
-        c->is_closing = 1;
+    for (int i = 0; i < MAX_WEB_EVENT_LOOPS; i++) {
+        if (!server->loop_mgrs[i]) {
+            continue;
+        }
+        for (struct mg_connection *c = server->loop_mgrs[i]->conns; c != NULL; c = c->next) {
+            c->is_closing = 1;
+        }
     }
 
     // First shutdown WebSocket manager to prevent any new WebSocket operations
@@ -604,10 +1018,13 @@ void http_server_destroy(http_server_handle_t server) {
     // No mutex to destroy
 
     // Free resources
-    if (server->mgr) {
-        free(server->mgr);
-        server->mgr = NULL;  // Avoid double-free
+    for (int i = 0; i < MAX_WEB_EVENT_LOOPS; i++) {
+        if (server->loop_mgrs[i]) {
+            free(server->loop_mgrs[i]);
+            server->loop_mgrs[i] = NULL;  // Avoid double-free
+        }
     }
+    server->mgr = NULL;
 
     if (server->handlers) {
         free(server->handlers);
@@ -617,6 +1034,10 @@ void http_server_destroy(http_server_handle_t server) {
     // Free route table
     free_route_table();
 
+    // Free cached web files
+    static_cache_free();
+    api_cache_free();
+
     // Finally free the server structure
     free(server);
     log_info("HTTP server destroyed");
@@ -668,30 +1089,30 @@ int http_server_register_handler(http_server_handle_t server, const char *path,
 /**
  * @brief Get server statistics
  *
- * Note: This function is kept for API compatibility but no longer tracks statistics
+ * The request rate is the average since the previous call.
  */
 int http_server_get_stats(http_server_handle_t server, int *active_connections,
                          double *requests_per_second, uint64_t *bytes_sent,
                          uint64_t *bytes_received) {
+    static pthread_mutex_t rate_mutex = PTHREAD_MUTEX_INITIALIZER;
+    static uint64_t last_requests = 0;
+    static uint64_t last_ms = 0;
+
     if (!server) {
         return -1;
     }
 
-    // Set all statistics to zero or default values
-    if (active_connections) {
-        *active_connections = 0;
-    }
+    uint64_t requests;
+    mg_limits_get_totals(active_connections, &requests, bytes_sent, bytes_received);
 
     if (requests_per_second) {
-        *requests_per_second = 0.0;
-    }
-
-    if (bytes_sent) {
-        *bytes_sent = 0;
-    }
-
-    if (bytes_received) {
-        *bytes_received = 0;
+        pthread_mutex_lock(&rate_mutex);
+        uint64_t now = mg_millis();
+        *requests_per_second = (last_ms != 0 && now > last_ms) ?
+                               (double)(requests - last_requests) * 1000.0 / (double)(now - last_ms) : 0.0;
+        last_requests = requests;
+        last_ms = now;
+        pthread_mutex_unlock(&rate_mutex);
     }
 
     return 0;
@@ -703,15 +1124,25 @@ int http_server_get_stats(http_server_handle_t server, int *active_connections,
 static void mongoose_event_handler(struct mg_connection *c, int ev, void *ev_data) {
     http_server_t *server = (http_server_t *)c->fn_data;
 
+    mg_limits_event(c, ev, ev_data);
+
     if (ev == MG_EV_ACCEPT) {
         // New connection accepted
         log_debug("New connection accepted");
 
-        // No statistics tracking
+        // Connections over the limits are turned away before anything else
+        if (!mg_limits_accept(c, server && server->config.ssl_enabled)) {
+            return;
+        }
 
         // Set Connection: close header for all responses to prevent connection reuse
         c->data[1] = 'C';  // Mark connection to add "Connection: close" header
 
+        // Session resumption and kernel TLS are set up per connection
+        if (server && server->config.ssl_enabled) {
+            mg_tls_setup_accepted(c, server->config.cert_path, server->config.key_path);
+        }
+
     } else if (ev == MG_EV_WS_OPEN) {
         // WebSocket connection opened
         log_info("WebSocket connection opened");
@@ -737,6 +1168,7 @@ static void mongoose_event_handler(struct mg_connection *c, int ev, void *ev_dat
 
         // Handle the wakeup event
         mg_handle_wakeup_event(c, ev_data);
+        mg_limits_after_request(c);
 
     } else if (ev == MG_EV_HTTP_MSG) {
         // HTTP request received
@@ -894,7 +1326,9 @@ static void mongoose_event_handler(struct mg_connection *c, int ev, void *ev_dat
 
             // Check if index.html exists
             struct stat st;
-            if (stat(index_path, &st) == 0 && S_ISREG(st.st_mode)) {
+            if (static_cache_serve(c, hm, "/index.html")) {
+                log_debug("Served index file for root path from memory");
+            } else if (stat(index_path, &st) == 0 && S_ISREG(st.st_mode)) {
                 // Use Mongoose's built-in file serving capabilities
                 struct mg_http_serve_opts opts = {
                     .root_dir = server->config.web_root,
@@ -927,6 +1361,11 @@ static void mongoose_event_handler(struct mg_connection *c, int ev, void *ev_dat
             }
             handled = true;
         }
+        else if (strcmp(uri, "/metrics") == 0 && mg_match(hm->method, mg_str("GET"), NULL)) {
+            // Prometheus scrape, formatted from counters without touching the database
+            mg_handle_get_metrics(c, hm);
+            handled = true;
+        }
         else if (is_api_request) {
             // Check if this is a WebSocket upgrade request
             struct mg_str *upgrade_header = mg_http_get_header(hm, "Upgrade");
@@ -956,7 +1395,9 @@ static void mongoose_event_handler(struct mg_connection *c, int ev, void *ev_dat
         } else if (is_direct_hls) {
             // For direct HLS requests, use the HLS handler
             log_debug("Handling direct HLS request: %s", uri);
+            size_t start = c->send.len;
             mg_handle_direct_hls_request(c, hm);
+            api_compress_response(c, api_response_encoding(hm), start);
             handled = true;
         } else if (is_static_asset) {
             // For static assets, serve directly
@@ -982,9 +1423,22 @@ static void mongoose_event_handler(struct mg_connection *c, int ev, void *ev_dat
         // Try to serve static file
         mongoose_server_handle_static_file(c, hm, server);
     }
+    mg_limits_after_request(c);
     } else if (ev == MG_EV_CLOSE) {
         // Connection closed
         log_debug("Connection closed");
+        mg_limits_close(c);
+
+        // Drop a blocking LL-HLS request the client gave up on
+        if (c->data[0] == 'L') {
+            mg_cancel_ll_hls_request(c);
+        } else if (c->data[0] == MG_SENDFILE_MARK) {
+            mg_cancel_file_transfer(c);
+        } else if (c->data[0] == MG_EXPORT_MARK) {
+            mg_cancel_export(c);
+        } else if (c->data[0] == MG_MJPEG_MARK) {
+            mg_cancel_mjpeg(c);
+        }
 
         // If this was a WebSocket connection, handle cleanup
         if (c->is_websocket) {
@@ -1020,7 +1474,19 @@ static void mongoose_event_handler(struct mg_connection *c, int ev, void *ev_dat
         // Connection error
         log_error("Connection error: %s", (char *)ev_data);
     } else if (ev == MG_EV_POLL) {
-        // Poll event - do nothing
+        // Answer blocking LL-HLS requests once their part is published
+        if (c->data[0] == 'L') {
+            mg_poll_ll_hls_request(c);
+        } else if (c->data[0] == MG_SENDFILE_MARK) {
+            // Send file bodies whenever the socket has room
+            mg_poll_file_transfer(c);
+        } else if (c->data[0] == MG_EXPORT_MARK) {
+            // Pass on exported data as the send buffer empties
+            mg_poll_export(c);
+        } else if (c->data[0] == MG_MJPEG_MARK) {
+            // Queue new live MJPEG frames
+            mg_poll_mjpeg(c);
+        }
     } else if (ev == MG_EV_READ || ev == MG_EV_WRITE) {
         // Read/write events - normal socket operations
         // No need to log these high-frequency events
@@ -1044,13 +1510,20 @@ static void mongoose_event_handler(struct mg_connection *c, int ev, void *ev_dat
  * This function runs in a separate thread and continuously calls mg_mgr_poll
  */
 static void *mongoose_server_event_loop(void *arg) {
-    http_server_t *server = (http_server_t *)arg;
+    event_loop_arg_t *loop = (event_loop_arg_t *)arg;
+    http_server_t *server = loop->server;
+    struct mg_mgr *mgr = loop->mgr;
+
+    char loop_index[8];
+    snprintf(loop_index, sizeof(loop_index), "%d", (int)(loop - s_event_loops));
+    thread_set_identity(THREAD_CLASS_WEB, "web", loop_index);
 
     log_info("Mongoose event loop started");
 
     // Run event loop until server is stopped
     int poll_count = 0;
     uint64_t last_cleanup_time = mg_millis();
+    uint64_t last_sweep_time = mg_millis();
     while (server->running) {
         // Check if shutdown has been initiated
         if (is_shutdown_initiated()) {
@@ -1060,7 +1533,16 @@ static void *mongoose_server_event_loop(void *arg) {
         }
 
         // Poll for events with a shorter timeout to be more responsive
-        mg_mgr_poll(server->mgr, 10);
+        mg_mgr_poll(mgr, 10);
+
+        // Send what other threads published to WebSocket clients
+        websocket_manager_flush(mgr);
+
+        // Close connections that ran out of time about once a second
+        if (mg_millis() - last_sweep_time >= 1000) {
+            last_sweep_time = mg_millis();
+            mg_limits_sweep(mgr);
+        }
 
         poll_count++;
 
@@ -1068,7 +1550,7 @@ static void *mongoose_server_event_loop(void *arg) {
         if (poll_count % 1000 == 0) {
             // Count active connections for debugging
             int active_count = 0;
-            for (struct mg_connection *c = server->mgr->conns; c != NULL; c = c->next) {
+            for (struct mg_connection *c = mgr->conns; c != NULL; c = c->next) {
                 active_count++;
             }
 
@@ -1081,7 +1563,7 @@ static void *mongoose_server_event_loop(void *arg) {
 
     // Immediately close all connections when the event loop stops
     log_info("Forcibly closing all remaining connections");
-    for (struct mg_connection *c = server->mgr->conns; c != NULL; c = c->next) {
+    for (struct mg_connection *c = mgr->conns; c != NULL; c = c->next) {
         // Mark all connections for closing
         c->is_closing = 1;
 
@@ -1102,7 +1584,7 @@ static void *mongoose_server_event_loop(void *arg) {
     }
 
     // Poll one more time to process closed connections
-    mg_mgr_poll(server->mgr, 0);
+    mg_mgr_poll(mgr, 0);
 
     return NULL;
 }
@@ -104,13 +104,14 @@ int mongoose_server_basic_auth_check(struct mg_http_message *hm, http_server_t *
                         char auth_value[512];
                         snprintf(auth_value, sizeof(auth_value), "Basic %s", auth_cookie_value);
                         
-                        // Create a static buffer for the header
-                        static char auth_header_buf[512];
+                        // Create a buffer for the header that outlives this block;
+                        // per thread, as event loops and workers authenticate concurrently
+                        static _Thread_local char auth_header_buf[512];
                         strncpy(auth_header_buf, auth_value, sizeof(auth_header_buf) - 1);
                         auth_header_buf[sizeof(auth_header_buf) - 1] = '\0';
                         
                         // Create a static mg_str for the header
-                        static struct mg_str static_auth_header;
+                        static _Thread_local struct mg_str static_auth_header;
                         static_auth_header.buf = auth_header_buf;
                         static_auth_header.len = strlen(auth_header_buf);
                         
@@ -0,0 +1,416 @@
+/**
+ * @file mongoose_server_limits.c
+ * @brief Connection limits, timeouts and send buffer caps of the web server
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "web/mongoose_server_limits.h"
+#include "web/mongoose_server_sendfile.h"
+#include "web/api_handlers_export.h"
+#include "web/api_handlers_mjpeg.h"
+#include "core/logger.h"
+#include "core/metrics.h"
+#include "mongoose.h"
+
+// Mark of a blocking LL-HLS request in c->data[0], see api_handlers_hls_ll.c
+#define LL_HLS_PENDING_MARK 'L'
+
+// Slots of a loop's connection table to start with; it doubles as needed
+#define CONN_TABLE_INITIAL 64
+
+// Reading resumes once the send buffer is down to this part of the cap
+#define SEND_RESUME_DIVISOR 2
+
+// State of an accepted connection
+typedef struct {
+    unsigned long id;           // Mongoose connection ID, 0 for a free slot
+    uint8_t ip[16];
+    uint64_t accepted_ms;
+    uint64_t active_ms;         // Last read or write
+    bool got_headers;
+    bool awaiting_worker;       // Request handed to a worker, answered by a wakeup
+    bool paused;                // Reading stopped until the send buffer drains
+} conn_state_t;
+
+// Open connections of one client address
+typedef struct {
+    uint8_t ip[16];
+    int count;
+} ip_count_t;
+
+static struct {
+    int max_connections;        // 0 for no limit
+    int max_per_ip;             // 0 for no limit
+    uint64_t header_timeout_ms; // 0 for none
+    uint64_t idle_timeout_ms;   // 0 for none
+    size_t send_limit;
+} s_limits = {
+    .send_limit = 256 * 1024,
+};
+
+// Connections of the calling event loop, open addressing by ID
+static _Thread_local conn_state_t *s_conns = NULL;
+static _Thread_local size_t s_conn_capacity = 0;
+static _Thread_local size_t s_conn_count = 0;
+
+// Shared by all event loops
+static pthread_mutex_t s_ip_mutex = PTHREAD_MUTEX_INITIALIZER;
+static ip_count_t *s_ips = NULL;
+static int s_ip_count = 0;
+static int s_ip_capacity = 0;
+
+static atomic_int s_active = 0;
+static atomic_uint_fast64_t s_requests = 0;
+static atomic_uint_fast64_t s_bytes_sent = 0;
+static atomic_uint_fast64_t s_bytes_received = 0;
+
+static metric_t s_metric_limit_total;
+static metric_t s_metric_limit_ip;
+static metric_t s_metric_header_timeout;
+static metric_t s_metric_idle_timeout;
+static metric_t s_metric_paused;
+static pthread_once_t s_metrics_once = PTHREAD_ONCE_INIT;
+
+static void register_metrics(void) {
+    s_metric_limit_total = metrics_counter("lightnvr_http_rejected_connections_total",
+                                           "Connections turned away by a connection limit",
+                                           "limit", "total", NULL);
+    s_metric_limit_ip = metrics_counter("lightnvr_http_rejected_connections_total",
+                                        "Connections turned away by a connection limit",
+                                        "limit", "per_ip", NULL);
+    s_metric_header_timeout = metrics_counter("lightnvr_http_timeouts_total",
+                                              "Connections closed for running out of time",
+                                              "timeout", "header", NULL);
+    s_metric_idle_timeout = metrics_counter("lightnvr_http_timeouts_total",
+                                            "Connections closed for running out of time",
+                                            "timeout", "idle", NULL);
+    s_metric_paused = metrics_counter("lightnvr_http_send_paused_total",
+                                      "Times reading from a connection stopped until its send buffer drained",
+                                      NULL);
+}
+
+void mg_limits_init(const http_server_config_t *config) {
+    pthread_once(&s_metrics_once, register_metrics);
+
+    s_limits.max_connections = config->max_connections > 0 ? config->max_connections : 0;
+    s_limits.max_per_ip = config->max_connections_per_ip > 0 ? config->max_connections_per_ip : 0;
+    s_limits.header_timeout_ms = config->header_timeout > 0 ? (uint64_t)config->header_timeout * 1000 : 0;
+    s_limits.idle_timeout_ms = config->connection_timeout > 0 ? (uint64_t)config->connection_timeout * 1000 : 0;
+    if (config->send_buffer_limit > 0) {
+        s_limits.send_limit = config->send_buffer_limit;
+    }
+
+    log_info("Web connections: at most %d (%d per address), header timeout %d s, idle timeout %d s, "
+             "send buffer %zu KiB", s_limits.max_connections, s_limits.max_per_ip, config->header_timeout,
+             config->connection_timeout, s_limits.send_limit / 1024);
+}
+
+size_t mg_send_limit(void) {
+    return s_limits.send_limit;
+}
+
+static conn_state_t *conn_find(unsigned long id) {
+    if (!s_conns) {
+        return NULL;
+    }
+    size_t mask = s_conn_capacity - 1;
+    for (size_t i = id & mask; s_conns[i].id != 0; i = (i + 1) & mask) {
+        if (s_conns[i].id == id) {
+            return &s_conns[i];
+        }
+    }
+    return NULL;
+}
+
+static conn_state_t *conn_slot(conn_state_t *table, size_t capacity, unsigned long id) {
+    size_t mask = capacity - 1;
+    size_t i = id & mask;
+    while (table[i].id != 0) {
+        i = (i + 1) & mask;
+    }
+    return &table[i];
+}
+
+/**
+ * Add a connection to the calling loop's table
+ *
+ * @return State of the connection, or NULL if out of memory
+ */
+static conn_state_t *conn_add(unsigned long id) {
+    // Kept at most three quarters full, so probes stay short and always end
+    if ((s_conn_count + 1) * 4 > s_conn_capacity * 3) {
+        size_t capacity = s_conn_capacity ? s_conn_capacity * 2 : CONN_TABLE_INITIAL;
+        conn_state_t *table = calloc(capacity, sizeof(conn_state_t));
+        if (!table) {
+            return NULL;
+        }
+        for (size_t i = 0; i < s_conn_capacity; i++) {
+            if (s_conns[i].id != 0) {
+                *conn_slot(table, capacity, s_conns[i].id) = s_conns[i];
+            }
+        }
+        free(s_conns);
+        s_conns = table;
+        s_conn_capacity = capacity;
+    }
+
+    conn_state_t *state = conn_slot(s_conns, s_conn_capacity, id);
+    memset(state, 0, sizeof(*state));
+    state->id = id;
+    s_conn_count++;
+    return state;
+}
+
+/**
+ * Remove a connection, moving back the entries probed past it
+ */
+static void conn_remove(conn_state_t *state) {
+    size_t mask = s_conn_capacity - 1;
+    size_t i = (size_t)(state - s_conns);
+    size_t j = i;
+    while (true) {
+        j = (j + 1) & mask;
+        if (s_conns[j].id == 0) {
+            break;
+        }
+        // An entry stays unless its home slot lies cyclically after the hole
+        size_t home = s_conns[j].id & mask;
+        bool stays = (i <= j) ? (i < home && home <= j) : (i < home || home <= j);
+        if (!stays) {
+            s_conns[i] = s_conns[j];
+            i = j;
+        }
+    }
+    s_conns[i].id = 0;
+    s_conn_count--;
+}
+
+/**
+ * Count a connection of an address
+ *
+ * @return false if the address has all the connections it may have
+ */
+static bool ip_acquire(const uint8_t *ip) {
+    bool ok = true;
+    pthread_mutex_lock(&s_ip_mutex);
+
+    int index = -1;
+    for (int i = 0; i < s_ip_count; i++) {
+        if (memcmp(s_ips[i].ip, ip, sizeof(s_ips[i].ip)) == 0) {
+            index = i;
+            break;
+        }
+    }
+
+    if (index >= 0) {
+        if (s_limits.max_per_ip > 0 && s_ips[index].count >= s_limits.max_per_ip) {
+            ok = false;
+        } else {
+            s_ips[index].count++;
+        }
+    } else {
+        if (s_ip_count == s_ip_capacity) {
+            int capacity = s_ip_capacity ? s_ip_capacity * 2 : 32;
+            ip_count_t *ips = realloc(s_ips, (size_t)capacity * sizeof(ip_count_t));
+            if (ips) {
+                s_ips = ips;
+                s_ip_capacity = capacity;
+            }
+        }
+        if (s_ip_count < s_ip_capacity) {
+            memcpy(s_ips[s_ip_count].ip, ip, sizeof(s_ips[s_ip_count].ip));
+            s_ips[s_ip_count].count = 1;
+            s_ip_count++;
+        } else {
+            ok = false;
+        }
+    }
+
+    pthread_mutex_unlock(&s_ip_mutex);
+    return ok;
+}
+
+static void ip_release(const uint8_t *ip) {
+    pthread_mutex_lock(&s_ip_mutex);
+    for (int i = 0; i < s_ip_count; i++) {
+        if (memcmp(s_ips[i].ip, ip, sizeof(s_ips[i].ip)) == 0) {
+            if (--s_ips[i].count <= 0) {
+                s_ips[i] = s_ips[--s_ip_count];
+            }
+            break;
+        }
+    }
+    pthread_mutex_unlock(&s_ip_mutex);
+}
+
+/**
+ * Turn a connection away
+ * Plain HTTP clients are told why; TLS ones are just closed, as the
+ * handshake has not happened.
+ */
+static void reject(struct mg_connection *c, bool tls, const char *why) {
+    char addr[64];
+    mg_snprintf(addr, sizeof(addr), "%M", mg_print_ip, &c->rem);
+    log_warn_ratelimited("Turning away connection from %s: %s", addr, why);
+    if (tls) {
+        c->is_closing = 1;
+        return;
+    }
+    mg_http_reply(c, 503, "Retry-After: 5\r\nConnection: close\r\n", "Too many connections\n");
+    c->is_draining = 1;
+    c->is_full = 1;
+}
+
+bool mg_limits_accept(struct mg_connection *c, bool tls) {
+    if (s_limits.max_connections > 0 && atomic_load(&s_active) >= s_limits.max_connections) {
+        metrics_add(s_metric_limit_total, 1);
+        reject(c, tls, "connection limit reached");
+        return false;
+    }
+    if (!ip_acquire(c->rem.ip)) {
+        metrics_add(s_metric_limit_ip, 1);
+        reject(c, tls, "connection limit of the address reached");
+        return false;
+    }
+
+    conn_state_t *state = conn_add(c->id);
+    if (!state) {
+        ip_release(c->rem.ip);
+        log_error("Failed to allocate state of connection %lu", c->id);
+        c->is_closing = 1;
+        return false;
+    }
+    memcpy(state->ip, c->rem.ip, sizeof(state->ip));
+    state->accepted_ms = mg_millis();
+    state->active_ms = state->accepted_ms;
+    atomic_fetch_add(&s_active, 1);
+    return true;
+}
+
+void mg_limits_event(struct mg_connection *c, int ev, void *ev_data) {
+    if (ev == MG_EV_READ && ev_data) {
+        atomic_fetch_add(&s_bytes_received, (uint64_t)*(long *)ev_data);
+    } else if (ev == MG_EV_WRITE && ev_data) {
+        atomic_fetch_add(&s_bytes_sent, (uint64_t)*(long *)ev_data);
+    } else if (ev == MG_EV_HTTP_MSG) {
+        atomic_fetch_add(&s_requests, 1);
+    } else if (ev != MG_EV_HTTP_HDRS && ev != MG_EV_WAKEUP) {
+        return;
+    }
+
+    conn_state_t *state = conn_find(c->id);
+    if (!state) {
+        return;
+    }
+
+    if (ev == MG_EV_READ || ev == MG_EV_WRITE) {
+        state->active_ms = mg_millis();
+    } else if (ev == MG_EV_HTTP_HDRS || ev == MG_EV_HTTP_MSG) {
+        state->got_headers = true;
+    } else if (ev == MG_EV_WAKEUP) {
+        state->awaiting_worker = false;
+        state->active_ms = mg_millis();
+    }
+
+    if (state->paused && c->send.len <= s_limits.send_limit / SEND_RESUME_DIVISOR) {
+        state->paused = false;
+        c->is_full = 0;
+    }
+}
+
+void mg_limits_after_request(struct mg_connection *c) {
+    conn_state_t *state = conn_find(c->id);
+    if (!state) {
+        return;
+    }
+
+    if (c->send.len == 0 && c->data[0] == '\0' && !c->is_websocket && !c->is_closing && !c->is_draining) {
+        state->awaiting_worker = true;
+    }
+
+    if (c->send.len > s_limits.send_limit && !state->paused) {
+        state->paused = true;
+        c->is_full = 1;
+        metrics_add(s_metric_paused, 1);
+    }
+}
+
+void mg_limits_touch(struct mg_connection *c, size_t bytes) {
+    atomic_fetch_add(&s_bytes_sent, (uint64_t)bytes);
+    conn_state_t *state = conn_find(c->id);
+    if (state) {
+        state->active_ms = mg_millis();
+    }
+}
+
+void mg_limits_close(struct mg_connection *c) {
+    conn_state_t *state = conn_find(c->id);
+    if (!state) {
+        return;
+    }
+    ip_release(state->ip);
+    conn_remove(state);
+    atomic_fetch_sub(&s_active, 1);
+}
+
+/**
+ * Whether a connection is waiting on the server rather than on its client
+ */
+static bool waiting_on_server(const struct mg_connection *c, const conn_state_t *state) {
+    if (c->is_websocket || c->data[0] == LL_HLS_PENDING_MARK || state->awaiting_worker) {
+        return true;
+    }
+    // An export with nothing queued is waiting for the muxer, a live MJPEG stream for its next frame
+    return (c->data[0] == MG_EXPORT_MARK || c->data[0] == MG_MJPEG_MARK) && c->send.len == 0;
+}
+
+void mg_limits_sweep(struct mg_mgr *mgr) {
+    if (s_conn_count == 0 || (s_limits.header_timeout_ms == 0 && s_limits.idle_timeout_ms == 0)) {
+        return;
+    }
+
+    uint64_t now = mg_millis();
+    for (struct mg_connection *c = mgr->conns; c != NULL; c = c->next) {
+        if (c->is_closing) {
+            continue;
+        }
+        conn_state_t *state = conn_find(c->id);
+        if (!state) {
+            continue;
+        }
+
+        if (s_limits.header_timeout_ms > 0 && !state->got_headers &&
+            now - state->accepted_ms > s_limits.header_timeout_ms) {
+            log_debug("Closing connection %lu that sent no request headers in time", c->id);
+            metrics_add(s_metric_header_timeout, 1);
+            c->is_closing = 1;
+        } else if (s_limits.idle_timeout_ms > 0 && !waiting_on_server(c, state) &&
+                   now - state->active_ms > s_limits.idle_timeout_ms) {
+            log_debug("Closing connection %lu, idle with %zu bytes unsent", c->id, c->send.len);
+            metrics_add(s_metric_idle_timeout, 1);
+            c->is_closing = 1;
+        }
+    }
+}
+
+void mg_limits_get_totals(int *active_connections, uint64_t *requests,
+                          uint64_t *bytes_sent, uint64_t *bytes_received) {
+    if (active_connections) {
+        *active_connections = atomic_load(&s_active);
+    }
+    if (requests) {
+        *requests = atomic_load(&s_requests);
+    }
+    if (bytes_sent) {
+        *bytes_sent = atomic_load(&s_bytes_sent);
+    }
+    if (bytes_received) {
+        *bytes_received = atomic_load(&s_bytes_received);
+    }
+}
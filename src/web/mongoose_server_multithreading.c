@@ -3,7 +3,8 @@
  * @brief Multithreading support for Mongoose server
  *
  * This file implements multithreading support for the Mongoose server,
- * allowing it to handle multiple requests in parallel.
+ * allowing it to handle multiple requests in parallel on a fixed pool of
+ * worker threads.
  */
 
 #include <stdio.h>
@@ -11,35 +12,17 @@
 #include <string.h>
 #include <pthread.h>
 #include <unistd.h>
+#include <stdint.h>
 
 #include "web/mongoose_server.h"
 #include "web/mongoose_server_multithreading.h"
+#include "web/api_response_compress.h"
 #include "core/logger.h"
 #include "core/shutdown_coordinator.h"
+#include "video/thread_utils.h"
 
 // Thread data structure is defined in the header file
 
-/**
- * @brief Start a thread
- *
- * @param f Thread function
- * @param p Thread data
- */
-void mg_start_thread(void *(*f)(void *), void *p) {
-#ifdef _WIN32
-  _beginthread((void(__cdecl *)(void *)) f, 0, p);
-#else
-#define closesocket(x) close(x)
-#include <pthread.h>
-  pthread_t thread_id = (pthread_t) 0;
-  pthread_attr_t attr;
-  (void) pthread_attr_init(&attr);
-  (void) pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
-  pthread_create(&thread_id, &attr, f, p);
-  pthread_attr_destroy(&attr);
-#endif
-}
-
 /**
  * @brief Thread function that processes the request
  *
@@ -79,6 +62,9 @@ void *mg_thread_function(void *param) {
 
       // Execute the handler function
       p->handler_func(&fake_conn, &hm);
+      api_compress_response(&fake_conn, api_response_encoding(&hm), 0);
+      api_cache_store(&p->cache, &fake_conn, 0);
+      metrics_observe_since(p->metric, p->queued_us);
 
       // Check if the handler sent a response directly
       if (fake_conn.send.buf && fake_conn.send.len > 0) {
@@ -122,6 +108,292 @@ void *mg_thread_function(void *param) {
   return NULL;
 }
 
+// Requests waiting for a worker
+typedef struct {
+  void *(*func)(void *);
+  void *arg;
+  const void *route;  // Handler the request runs, for the per-route limit
+} mg_pool_task_t;
+
+// Worker pool for offloaded requests
+static struct {
+  pthread_t *threads;
+  const void **running_routes;  // Route each worker is running, NULL when idle
+  int thread_count;
+  mg_pool_task_t *queue;        // Waiting requests, oldest first
+  int queue_size;
+  int queue_count;
+  int route_limit;
+  bool running;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+} s_pool = {
+  .mutex = PTHREAD_MUTEX_INITIALIZER,
+  .cond = PTHREAD_COND_INITIALIZER,
+};
+
+// Route of a task: the API handler for requests, the function otherwise
+static const void *task_route(void *(*f)(void *), void *p) {
+  if (f == mg_thread_function && p && ((struct mg_thread_data *) p)->handler_func) {
+    return (const void *) ((struct mg_thread_data *) p)->handler_func;
+  }
+  return (const void *) f;
+}
+
+// Free a request that will not run
+static void discard_task(const mg_pool_task_t *task) {
+  if (task->func == mg_thread_function && task->arg) {
+    struct mg_thread_data *data = (struct mg_thread_data *) task->arg;
+    free((void *) data->message.buf);
+    free(data);
+  }
+}
+
+// Index of the oldest queued task whose route is below its limit, -1 if none
+// Must be called with s_pool.mutex held
+static int next_runnable_task(void) {
+  for (int i = 0; i < s_pool.queue_count; i++) {
+    if (s_pool.route_limit <= 0) {
+      return i;
+    }
+
+    int active = 0;
+    for (int w = 0; w < s_pool.thread_count; w++) {
+      if (s_pool.running_routes[w] == s_pool.queue[i].route) {
+        active++;
+      }
+    }
+    if (active < s_pool.route_limit) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static void *mg_pool_worker(void *param) {
+  int index = (int) (intptr_t) param;
+
+  char worker_index[8];
+  snprintf(worker_index, sizeof(worker_index), "%d", index);
+  thread_set_identity(THREAD_CLASS_WEB, "web-pool", worker_index);
+
+  pthread_mutex_lock(&s_pool.mutex);
+  for (;;) {
+    int i;
+    while (s_pool.running && (i = next_runnable_task()) < 0) {
+      pthread_cond_wait(&s_pool.cond, &s_pool.mutex);
+    }
+    if (!s_pool.running) {
+      break;
+    }
+
+    mg_pool_task_t task = s_pool.queue[i];
+    memmove(&s_pool.queue[i], &s_pool.queue[i + 1],
+            (size_t) (s_pool.queue_count - i - 1) * sizeof(mg_pool_task_t));
+    s_pool.queue_count--;
+    s_pool.running_routes[index] = task.route;
+    pthread_mutex_unlock(&s_pool.mutex);
+
+    task.func(task.arg);
+
+    pthread_mutex_lock(&s_pool.mutex);
+    s_pool.running_routes[index] = NULL;
+    // A task held back by the route limit may be runnable now
+    pthread_cond_broadcast(&s_pool.cond);
+  }
+  pthread_mutex_unlock(&s_pool.mutex);
+
+  return NULL;
+}
+
+/**
+ * @brief Start the worker pool that runs offloaded requests
+ */
+int mg_worker_pool_start(int threads, int queue_size, int route_limit) {
+  if (threads < 1 || queue_size < 1) {
+    log_error("Invalid worker pool size: %d threads, queue of %d", threads, queue_size);
+    return -1;
+  }
+
+  pthread_mutex_lock(&s_pool.mutex);
+  if (s_pool.running) {
+    pthread_mutex_unlock(&s_pool.mutex);
+    return 0;
+  }
+
+  s_pool.threads = calloc((size_t) threads, sizeof(pthread_t));
+  s_pool.running_routes = calloc((size_t) threads, sizeof(void *));
+  s_pool.queue = calloc((size_t) queue_size, sizeof(mg_pool_task_t));
+  if (!s_pool.threads || !s_pool.running_routes || !s_pool.queue) {
+    log_error("Failed to allocate memory for worker pool");
+    free(s_pool.threads);
+    free(s_pool.running_routes);
+    free(s_pool.queue);
+    s_pool.threads = NULL;
+    s_pool.running_routes = NULL;
+    s_pool.queue = NULL;
+    pthread_mutex_unlock(&s_pool.mutex);
+    return -1;
+  }
+
+  s_pool.queue_size = queue_size;
+  s_pool.queue_count = 0;
+  s_pool.route_limit = route_limit;
+  s_pool.thread_count = 0;
+  s_pool.running = true;
+
+  for (int i = 0; i < threads; i++) {
+    if (pthread_create(&s_pool.threads[i], NULL, mg_pool_worker, (void *) (intptr_t) i) != 0) {
+      log_error("Failed to create worker thread %d", i);
+      break;
+    }
+    s_pool.thread_count++;
+  }
+  int started = s_pool.thread_count;
+  pthread_mutex_unlock(&s_pool.mutex);
+
+  if (started == 0) {
+    mg_worker_pool_stop();
+    return -1;
+  }
+
+  log_info("Started %d web worker threads (queue %d, route limit %d)", started, queue_size, route_limit);
+  return 0;
+}
+
+/**
+ * @brief Stop the worker pool
+ */
+void mg_worker_pool_stop(void) {
+  pthread_mutex_lock(&s_pool.mutex);
+  if (!s_pool.threads) {
+    pthread_mutex_unlock(&s_pool.mutex);
+    return;
+  }
+  s_pool.running = false;
+  pthread_cond_broadcast(&s_pool.cond);
+  int thread_count = s_pool.thread_count;
+  pthread_mutex_unlock(&s_pool.mutex);
+
+  for (int i = 0; i < thread_count; i++) {
+    pthread_join(s_pool.threads[i], NULL);
+  }
+
+  pthread_mutex_lock(&s_pool.mutex);
+  for (int i = 0; i < s_pool.queue_count; i++) {
+    discard_task(&s_pool.queue[i]);
+  }
+  if (s_pool.queue_count > 0) {
+    log_info("Dropped %d queued web requests", s_pool.queue_count);
+  }
+  free(s_pool.threads);
+  free(s_pool.running_routes);
+  free(s_pool.queue);
+  s_pool.threads = NULL;
+  s_pool.running_routes = NULL;
+  s_pool.queue = NULL;
+  s_pool.thread_count = 0;
+  s_pool.queue_count = 0;
+  pthread_mutex_unlock(&s_pool.mutex);
+
+  log_info("Web worker threads stopped");
+}
+
+/**
+ * @brief Run a function on the worker pool
+ *
+ * @param f Thread function
+ * @param p Thread data
+ * @return int 0 on success, -1 if the queue is full
+ */
+int mg_start_thread(void *(*f)(void *), void *p) {
+  pthread_mutex_lock(&s_pool.mutex);
+  if (s_pool.running) {
+    if (s_pool.queue_count >= s_pool.queue_size) {
+      pthread_mutex_unlock(&s_pool.mutex);
+      log_warn("Web request queue full (%d waiting), refusing request", s_pool.queue_size);
+      return -1;
+    }
+
+    mg_pool_task_t *task = &s_pool.queue[s_pool.queue_count++];
+    task->func = f;
+    task->arg = p;
+    task->route = task_route(f, p);
+    // Broadcast: the first waiting worker may not be able to take it
+    pthread_cond_broadcast(&s_pool.cond);
+    pthread_mutex_unlock(&s_pool.mutex);
+    return 0;
+  }
+  pthread_mutex_unlock(&s_pool.mutex);
+
+#ifdef _WIN32
+  _beginthread((void(__cdecl *)(void *)) f, 0, p);
+#else
+  pthread_t thread_id = (pthread_t) 0;
+  pthread_attr_t attr;
+  (void) pthread_attr_init(&attr);
+  (void) pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  int rc = pthread_create(&thread_id, &attr, f, p);
+  pthread_attr_destroy(&attr);
+  if (rc != 0) {
+    return -1;
+  }
+#endif
+  return 0;
+}
+
+/**
+ * @brief Hand a request to the worker pool
+ */
+bool mg_offload_request(struct mg_connection *c, struct mg_http_message *hm,
+                        void (*handler_func)(struct mg_connection *c, struct mg_http_message *hm)) {
+  return mg_offload_route(c, hm, handler_func, 0, NULL);
+}
+
+/**
+ * @brief Hand a request for an API route to the worker pool
+ */
+bool mg_offload_route(struct mg_connection *c, struct mg_http_message *hm,
+                      void (*handler_func)(struct mg_connection *c, struct mg_http_message *hm),
+                      metric_t metric, const api_cache_ctx_t *cache) {
+  // Allocate thread data
+  struct mg_thread_data *data = (struct mg_thread_data *) calloc(1, sizeof(*data));
+  if (!data) {
+    log_error("Failed to allocate memory for thread data");
+    mg_http_reply(c, 500, "", "Internal Server Error\n");
+    return false;
+  }
+
+  // Copy the HTTP message
+  data->message = mg_strdup(hm->message);
+  if (data->message.len == 0) {
+    log_error("Failed to duplicate HTTP message");
+    free(data);
+    mg_http_reply(c, 500, "", "Internal Server Error\n");
+    return false;
+  }
+
+  // Set connection ID, manager, and handler function
+  data->conn_id = c->id;
+  data->mgr = c->mgr;
+  data->handler_func = handler_func;
+  data->metric = metric;
+  data->queued_us = metric ? metrics_now_us() : 0;
+  if (cache) {
+    data->cache = *cache;
+  }
+
+  if (mg_start_thread(mg_thread_function, data) != 0) {
+    free((void *) data->message.buf);
+    free(data);
+    mg_http_reply(c, 503, "Content-Type: application/json\r\nRetry-After: 1\r\n",
+                  "{\"error\": \"Server busy, try again\"}\n");
+    return false;
+  }
+
+  return true;
+}
+
 /**
  * @brief Handle HTTP request with multithreading
  *
@@ -143,8 +415,8 @@ bool mg_handle_request_with_threading(struct mg_connection *c,
     // Return false to let the normal request handling continue
     return false;
   } else {
-    // Multithreading path - spawn a thread to handle the request
-    log_debug("Spawning thread to handle request: %.*s",
+    // Multithreading path - queue the request for a worker
+    log_debug("Queueing request for a worker: %.*s",
              (int)hm->uri.len, hm->uri.buf);
 
     // Extract URI for logging
@@ -155,31 +427,8 @@ bool mg_handle_request_with_threading(struct mg_connection *c,
 
     log_debug("Handling request with threading: %s", uri);
 
-    // Allocate thread data
-    struct mg_thread_data *data =
-        (struct mg_thread_data *) calloc(1, sizeof(*data));
-
-    if (!data) {
-      log_error("Failed to allocate memory for thread data");
-      mg_http_reply(c, 500, "", "Internal Server Error\n");
-      return true;
-    }
-
-    // Copy the HTTP message
-    data->message = mg_strdup(hm->message);
-    if (data->message.len == 0) {
-      log_error("Failed to duplicate HTTP message");
-      free(data);
-      mg_http_reply(c, 500, "", "Internal Server Error\n");
-      return true;
-    }
-
-    // Set connection ID, manager, and handler function
-    data->conn_id = c->id;
-    data->mgr = c->mgr;
-
-    // Start thread
-    mg_start_thread(mg_thread_function, data);
+    // Queue for the worker pool; errors have been answered already
+    mg_offload_request(c, hm, NULL);
 
     return true;
   }
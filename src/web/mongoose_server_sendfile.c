@@ -0,0 +1,511 @@
+/**
+ * @file mongoose_server_sendfile.c
+ * @brief Zero-copy file responses for plain HTTP and kernel TLS connections
+ *
+ * mg_http_serve_file reads files chunk by chunk into the connection's send
+ * buffer. For recordings and HLS segments this copies every byte through
+ * user space; here the body goes from the page cache to the socket with
+ * sendfile() instead, whenever the socket has room. On HTTPS connections
+ * whose records the kernel encrypts (see mongoose_server_tls.h) the body
+ * is sent the same way.
+ *
+ * A response can also splice two parts of one file: its head followed by
+ * everything from a later offset, which serves a fragmented MP4 recording
+ * from a given fragment on. Or it can concatenate several files, which
+ * serves a recording kept as HLS segments as one fragmented MP4; those
+ * responses also work on TLS connections encrypted in user space, copying
+ * through user space.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+#include "web/mongoose_server_sendfile.h"
+#include "web/mongoose_server_tls.h"
+#include "web/mongoose_server_limits.h"
+#include "core/logger.h"
+#include "mongoose.h"
+
+// Most transfers at the same time; further ones use mg_http_serve_file
+#define MAX_FILE_TRANSFERS 64
+
+// Bytes sent to one connection per poll, so one client cannot hold up the others
+#define TRANSFER_POLL_BUDGET (4 * 1024 * 1024)
+
+// Size of each read into the send buffer of TLS connections, which is
+// filled up to mg_send_limit()
+#define TRANSFER_TLS_CHUNK (16 * 1024)
+
+/**
+ * File body being sent on a connection
+ * Only used from the event loop thread that owns the connection. Each loop
+ * has its own table, since connection IDs are only unique within a loop.
+ */
+typedef struct {
+    bool used;
+    unsigned long conn_id;
+    int fd;
+    off_t offset;               // Next byte of the response to send
+    off_t end;                  // One past the last byte of the response to send
+    off_t head_end;             // Response bytes from here on come from the file at tail_offset
+    off_t tail_offset;
+
+    // Concatenated files; fd is then the file of part, opened as the body reaches it
+    char **paths;
+    off_t *part_ends;           // Response offset one past each file
+    int part_count;
+    int part;
+} file_transfer_t;
+
+static _Thread_local file_transfer_t transfers[MAX_FILE_TRANSFERS];
+
+static file_transfer_t *find_transfer(const struct mg_connection *c) {
+    for (int i = 0; i < MAX_FILE_TRANSFERS; i++) {
+        if (transfers[i].used && transfers[i].conn_id == c->id) {
+            return &transfers[i];
+        }
+    }
+    return NULL;
+}
+
+static void release_transfer(struct mg_connection *c, file_transfer_t *transfer) {
+    if (transfer) {
+        if (transfer->fd >= 0) {
+            close(transfer->fd);
+        }
+        for (int i = 0; i < transfer->part_count; i++) {
+            free(transfer->paths[i]);
+        }
+        free(transfer->paths);
+        free(transfer->part_ends);
+        transfer->paths = NULL;
+        transfer->part_ends = NULL;
+        transfer->part_count = 0;
+        transfer->used = false;
+    }
+    c->data[0] = '\0';
+}
+
+static file_transfer_t *find_free_transfer(void) {
+    for (int i = 0; i < MAX_FILE_TRANSFERS; i++) {
+        if (!transfers[i].used) {
+            return &transfers[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Parse a single-range Range header against a file size
+ *
+ * @return 1 if a range was parsed into start and end (exclusive), 0 if the
+ *         header should be ignored, -1 if the range cannot be satisfied
+ */
+static int parse_range(const struct mg_str *header, off_t size, off_t *start, off_t *end) {
+    char buf[64];
+    if (header->len >= sizeof(buf)) {
+        return 0;
+    }
+    memcpy(buf, header->buf, header->len);
+    buf[header->len] = '\0';
+
+    // Multiple ranges get the whole file, like mg_http_serve_file does
+    if (strncmp(buf, "bytes=", 6) != 0 || strchr(buf, ',')) {
+        return 0;
+    }
+
+    long long first = -1, last = -1;
+    const char *spec = buf + 6;
+    if (spec[0] == '-') {
+        // Suffix range: the last N bytes
+        if (sscanf(spec + 1, "%lld", &last) != 1 || last <= 0) {
+            return 0;
+        }
+        if (size == 0) {
+            return -1;
+        }
+        *start = last >= size ? 0 : size - (off_t)last;
+        *end = size;
+        return 1;
+    }
+
+    int fields = sscanf(spec, "%lld-%lld", &first, &last);
+    if (fields < 1 || first < 0 || (fields == 2 && last < first)) {
+        return 0;
+    }
+    if (first >= size) {
+        return -1;
+    }
+
+    *start = (off_t)first;
+    *end = (fields == 2 && last < size) ? (off_t)last + 1 : size;
+    return 1;
+}
+
+/**
+ * Answer a conditional or range request, or send the headers of the body
+ *
+ * @param size Size of the body before any range is applied
+ * @param etag Validator of the body
+ * @param start Receives the first byte of the body to send
+ * @param end Receives one past the last byte of the body to send
+ * @return true if the body is to be sent, false if the response is complete
+ */
+static bool send_headers(struct mg_connection *c, struct mg_http_message *hm, off_t size,
+                         const char *etag, const char *extra_headers, off_t *start, off_t *end) {
+    struct mg_str *inm = mg_http_get_header(hm, "If-None-Match");
+    if (inm && mg_strcmp(*inm, mg_str(etag)) == 0) {
+        mg_http_reply(c, 304, extra_headers ? extra_headers : "", "");
+        return false;
+    }
+
+    *start = 0;
+    *end = size;
+    int status = 200;
+    char range_header[96] = "";
+    struct mg_str *range = mg_http_get_header(hm, "Range");
+    if (range) {
+        int parsed = parse_range(range, size, start, end);
+        if (parsed < 0) {
+            mg_printf(c, "HTTP/1.1 416 Range Not Satisfiable\r\n%sContent-Range: bytes */%lld\r\n"
+                         "Content-Length: 0\r\n\r\n",
+                      extra_headers ? extra_headers : "", (long long)size);
+            return false;
+        }
+        if (parsed > 0) {
+            status = 206;
+            snprintf(range_header, sizeof(range_header), "Content-Range: bytes %lld-%lld/%lld\r\n",
+                     (long long)*start, (long long)*end - 1, (long long)size);
+        }
+    }
+
+    mg_printf(c, "HTTP/1.1 %d %s\r\n%sEtag: %s\r\nAccept-Ranges: bytes\r\n%sContent-Length: %lld\r\n\r\n",
+              status, status == 206 ? "Partial Content" : "OK", extra_headers ? extra_headers : "",
+              etag, range_header, (long long)(*end - *start));
+
+    return mg_strcmp(hm->method, mg_str("HEAD")) != 0 && *end > *start;
+}
+
+static void serve_buffered(struct mg_connection *c, struct mg_http_message *hm,
+                           const char *path, const char *extra_headers) {
+    struct mg_http_serve_opts opts = {
+        .mime_types = "",  // Content-Type is in extra_headers
+        .extra_headers = extra_headers
+    };
+    mg_http_serve_file(c, hm, path, &opts);
+}
+
+/**
+ * Serve a file, or its head plus its tail from tail_offset on
+ *
+ * @param head_len Bytes taken from the start of the file, -1 for the whole file
+ * @return 0 if a response was sent, -1 if a spliced response cannot be sent
+ *         with sendfile (nothing was sent)
+ */
+static int serve_file(struct mg_connection *c, struct mg_http_message *hm, const char *path,
+                      off_t head_len, off_t tail_offset, const char *extra_headers) {
+    bool spliced = head_len >= 0;
+#ifndef __linux__
+    if (spliced) {
+        return -1;
+    }
+    serve_buffered(c, hm, path, extra_headers);
+    return 0;
+#else
+    // TLS encrypted in user space needs the data there, and request copies
+    // handled on worker threads have no socket of their own
+    if ((c->is_tls && !mg_tls_kernel_send(c)) || c->fd == NULL || !hm) {
+        if (spliced) {
+            return -1;
+        }
+        serve_buffered(c, hm, path, extra_headers);
+        return 0;
+    }
+
+    file_transfer_t *transfer = find_free_transfer();
+    if (!transfer) {
+        if (spliced) {
+            return -1;
+        }
+        log_debug("All %d file transfers in use, serving %s buffered", MAX_FILE_TRANSFERS, path);
+        serve_buffered(c, hm, path, extra_headers);
+        return 0;
+    }
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        mg_http_reply(c, 404, "", "Not found\n");
+        return 0;
+    }
+
+    // Size of the response body before any range is applied
+    off_t size = st.st_size;
+    if (spliced) {
+        if (head_len > tail_offset || tail_offset > st.st_size) {
+            close(fd);
+            return -1;
+        }
+        size = head_len + (st.st_size - tail_offset);
+    } else {
+        head_len = st.st_size;
+        tail_offset = st.st_size;
+    }
+
+    // Same validator as mg_http_serve_file, plus the splice point
+    char etag[64];
+    if (spliced) {
+        snprintf(etag, sizeof(etag), "\"%lld.%lld.%lld\"", (long long)st.st_mtime,
+                 (long long)st.st_size, (long long)tail_offset);
+    } else {
+        snprintf(etag, sizeof(etag), "\"%lld.%lld\"", (long long)st.st_mtime, (long long)st.st_size);
+    }
+
+    off_t start, end;
+    if (!send_headers(c, hm, size, etag, extra_headers, &start, &end)) {
+        close(fd);
+        return 0;
+    }
+
+    if (end > head_len) {
+        posix_fadvise(fd, tail_offset, 0, POSIX_FADV_SEQUENTIAL);
+    } else {
+        posix_fadvise(fd, start, end - start, POSIX_FADV_SEQUENTIAL);
+    }
+
+    transfer->used = true;
+    transfer->conn_id = c->id;
+    transfer->fd = fd;
+    transfer->offset = start;
+    transfer->end = end;
+    transfer->head_end = head_len;
+    transfer->tail_offset = tail_offset;
+    c->data[0] = MG_SENDFILE_MARK;
+    return 0;
+#endif
+}
+
+/**
+ * Open the file of a concatenated transfer that holds its next byte
+ *
+ * @param file_offset Receives the offset of that byte in the file
+ * @param part_end Receives the response offset the file ends at
+ * @return 0 on success, -1 if the file cannot be opened
+ */
+static int open_concat_part(file_transfer_t *transfer, off_t *file_offset, off_t *part_end) {
+    int part = transfer->part < 0 ? 0 : transfer->part;
+    while (part < transfer->part_count - 1 && transfer->offset >= transfer->part_ends[part]) {
+        part++;
+    }
+
+    if (part != transfer->part || transfer->fd < 0) {
+        if (transfer->fd >= 0) {
+            close(transfer->fd);
+        }
+        transfer->part = part;
+        transfer->fd = open(transfer->paths[part], O_RDONLY | O_CLOEXEC);
+        if (transfer->fd < 0) {
+            log_debug("Failed to open %s for a file transfer: %s", transfer->paths[part], strerror(errno));
+            return -1;
+        }
+#ifdef __linux__
+        posix_fadvise(transfer->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    }
+
+    off_t part_start = part > 0 ? transfer->part_ends[part - 1] : 0;
+    *file_offset = transfer->offset - part_start;
+    *part_end = transfer->part_ends[part] < transfer->end ? transfer->part_ends[part] : transfer->end;
+    return 0;
+}
+
+void mg_serve_file_zero_copy(struct mg_connection *c, struct mg_http_message *hm,
+                             const char *path, const char *extra_headers) {
+    serve_file(c, hm, path, -1, 0, extra_headers);
+}
+
+int mg_serve_file_spliced(struct mg_connection *c, struct mg_http_message *hm, const char *path,
+                          off_t head_len, off_t tail_offset, const char *extra_headers) {
+    if (head_len < 0) {
+        return -1;
+    }
+    return serve_file(c, hm, path, head_len, tail_offset, extra_headers);
+}
+
+int mg_serve_files_concat(struct mg_connection *c, struct mg_http_message *hm,
+                          const char *const *paths, int count, const char *extra_headers) {
+    // Request copies handled on worker threads have no socket of their own
+    if (!paths || count <= 0 || c->fd == NULL || !hm) {
+        return -1;
+    }
+
+    file_transfer_t *transfer = find_free_transfer();
+    if (!transfer) {
+        return -1;
+    }
+
+    char **copies = calloc((size_t)count, sizeof(char *));
+    off_t *part_ends = calloc((size_t)count, sizeof(off_t));
+    if (!copies || !part_ends) {
+        free(copies);
+        free(part_ends);
+        return -1;
+    }
+
+    // Files are sized up front for the Content-Length; they do not change once written
+    off_t size = 0;
+    time_t mtime = 0;
+    for (int i = 0; i < count; i++) {
+        struct stat st;
+        copies[i] = strdup(paths[i]);
+        if (!copies[i] || stat(paths[i], &st) != 0 || !S_ISREG(st.st_mode)) {
+            for (int j = 0; j <= i; j++) {
+                free(copies[j]);
+            }
+            free(copies);
+            free(part_ends);
+            mg_http_reply(c, 404, "", "Not found\n");
+            return 0;
+        }
+        size += st.st_size;
+        part_ends[i] = size;
+        if (st.st_mtime > mtime) {
+            mtime = st.st_mtime;
+        }
+    }
+
+    char etag[64];
+    snprintf(etag, sizeof(etag), "\"%lld.%lld.%d\"", (long long)mtime, (long long)size, count);
+
+    off_t start, end;
+    if (!send_headers(c, hm, size, etag, extra_headers, &start, &end)) {
+        for (int i = 0; i < count; i++) {
+            free(copies[i]);
+        }
+        free(copies);
+        free(part_ends);
+        return 0;
+    }
+
+    transfer->used = true;
+    transfer->conn_id = c->id;
+    transfer->fd = -1;
+    transfer->offset = start;
+    transfer->end = end;
+    transfer->paths = copies;
+    transfer->part_ends = part_ends;
+    transfer->part_count = count;
+    transfer->part = -1;
+    c->data[0] = MG_SENDFILE_MARK;
+    return 0;
+}
+
+void mg_poll_file_transfer(struct mg_connection *c) {
+    file_transfer_t *transfer = find_transfer(c);
+    if (!transfer) {
+        c->data[0] = '\0';
+        return;
+    }
+
+    // Headers and anything else Mongoose queued go out first; TLS
+    // connections encrypted in user space take the body through the send
+    // buffer as well
+    bool copy = c->is_tls && !mg_tls_kernel_send(c);
+    if (c->is_closing || (!copy && c->send.len > 0)) {
+        return;
+    }
+
+    int sock = (int)(size_t)c->fd;
+    size_t budget = TRANSFER_POLL_BUDGET;
+    while (transfer->offset < transfer->end && budget > 0) {
+        // Map the response position to the file, stopping at the splice point
+        // or at the end of the current file of a concatenation
+        off_t file_offset = transfer->offset;
+        off_t part_end = transfer->end;
+        if (transfer->paths) {
+            if (open_concat_part(transfer, &file_offset, &part_end) != 0) {
+                c->is_closing = 1;
+                release_transfer(c, transfer);
+                return;
+            }
+        } else if (transfer->offset < transfer->head_end) {
+            if (part_end > transfer->head_end) {
+                part_end = transfer->head_end;
+            }
+        } else {
+            file_offset = transfer->tail_offset + (transfer->offset - transfer->head_end);
+        }
+
+        size_t chunk = (size_t)(part_end - transfer->offset);
+        if (chunk > budget) {
+            chunk = budget;
+        }
+
+        ssize_t sent;
+        if (copy) {
+            // Encrypted in user space, so read into the send buffer until it is full enough
+            if (c->send.len >= mg_send_limit()) {
+                return;
+            }
+            char buffer[TRANSFER_TLS_CHUNK];
+            if (chunk > sizeof(buffer)) {
+                chunk = sizeof(buffer);
+            }
+            sent = pread(transfer->fd, buffer, chunk, file_offset);
+            if (sent > 0) {
+                mg_send(c, buffer, (size_t)sent);
+            }
+        } else {
+#ifdef __linux__
+            sent = sendfile(sock, transfer->fd, &file_offset, chunk);
+#else
+            (void)sock;
+            sent = -1;
+            errno = ENOSYS;
+#endif
+        }
+        if (sent > 0) {
+            transfer->offset += sent;
+            budget -= (size_t)sent;
+            if (!copy) {
+                mg_limits_touch(c, (size_t)sent);
+            }
+            continue;
+        }
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent < 0 && errno == EAGAIN) {
+            // Socket buffer full, continue on the next poll
+            return;
+        }
+
+        // The client went away, or the file shrank below its Content-Length
+        log_debug("File transfer on connection %lu ended early: %s",
+                  c->id, sent < 0 ? strerror(errno) : "end of file");
+        c->is_closing = 1;
+        release_transfer(c, transfer);
+        return;
+    }
+
+    if (transfer->offset >= transfer->end) {
+        release_transfer(c, transfer);
+    }
+}
+
+void mg_cancel_file_transfer(struct mg_connection *c) {
+    release_transfer(c, find_transfer(c));
+}
@@ -11,6 +11,11 @@
 #include "core/logger.h"
 #include "core/config.h"
 #include "video/streams.h"
+#include "video/hls/hls_viewers.h"
+#include "web/api_handlers.h"
+#include "web/mongoose_server_sendfile.h"
+#include "web/mongoose_server_static_cache.h"
+#include "web/mongoose_server_static_cache.h"
 #include "database/db_auth.h"
 
 #ifdef USE_GO2RTC
@@ -134,6 +139,18 @@ void mongoose_server_handle_static_file(struct mg_connection *c, struct mg_http_
         
         // Extract file name (everything after the stream name)
         const char *file_name = file_part + 1; // Skip "/"
+
+        // Every request keeps an on-demand stream's HLS output running
+        hls_viewers_touch(decoded_stream_name);
+
+        // The mosaic and renditions are served by their transcoders, segments of
+        // streams written by our HLS writer come from the segment index
+        if (mg_handle_mosaic_hls_request(c, hm, decoded_stream_name, file_name) ||
+            mg_handle_abr_hls_request(c, hm, decoded_stream_name, file_name) ||
+            mg_handle_ll_hls_request(c, hm, decoded_stream_name, file_name) ||
+            mg_serve_indexed_hls_segment(c, hm, decoded_stream_name, file_name)) {
+            return;
+        }
         
         // Construct the full path to the HLS file
         char hls_file_path[MAX_PATH_LENGTH * 2]; // Double the buffer size to avoid truncation
@@ -208,10 +225,15 @@ void mongoose_server_handle_static_file(struct mg_connection *c, struct mg_http_
                 "Access-Control-Allow-Headers: Origin, Content-Type, Accept, Authorization\r\n",
                 content_type_header, cache_control);
             
-            mg_http_serve_file(c, hm, hls_file_path, &(struct mg_http_serve_opts){
-                .mime_types = "",
-                .extra_headers = headers
-            });
+            // Segments are sent zero-copy; playlists are small and may be rewritten in place
+            if (strstr(file_name, ".m3u8")) {
+                mg_http_serve_file(c, hm, hls_file_path, &(struct mg_http_serve_opts){
+                    .mime_types = "",
+                    .extra_headers = headers
+                });
+            } else {
+                mg_serve_file_zero_copy(c, hm, hls_file_path, headers);
+            }
             return;
         } else {
             // File doesn't exist - let the client know
@@ -219,12 +241,27 @@ void mongoose_server_handle_static_file(struct mg_connection *c, struct mg_http_
             // is responsible for creating the actual HLS files
             log_info("HLS file not found: %s (waiting for FFmpeg to create it)", hls_file_path);
             
+            // An on-demand stream that was idle needs a segment before its playlist exists
+            if (strstr(file_name, ".m3u8") && hls_viewers_on_demand(decoded_stream_name)) {
+                mg_http_reply(c, 503, "Retry-After: 1\r\n", "{\"error\": \"HLS stream is starting\"}\n");
+                return;
+            }
+
             // Return a 404 with a message that indicates the file is being generated
             mg_http_reply(c, 404, "", "{\"error\": \"HLS file not found or still being generated by FFmpeg\"}\n");
             return;
         }
     }
 
+    // Web interface files are answered from memory
+    const char *cache_path = uri;
+    if (strcmp(uri, "/") == 0 || strcmp(uri, "/index.html") == 0) {
+        cache_path = g_config.webrtc_disabled ? "/hls.html" : "/index.html";
+    }
+    if (static_cache_serve(c, hm, cache_path)) {
+        return;
+    }
+
     // Special handling for root path or index.html
     if (strcmp(uri, "/") == 0 || strcmp(uri, "/index.html") == 0) {
         // Check if WebRTC is disabled in the configuration
@@ -0,0 +1,391 @@
+/**
+ * @file mongoose_server_static_cache.c
+ * @brief In-memory cache of the web interface files
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "web/mongoose_server_static_cache.h"
+#include "web/api_response_compress.h"
+#include "core/config.h"
+#include "core/logger.h"
+#include "utils/memory.h"
+#include "mongoose.h"
+
+// Larger files are served from disk
+#define STATIC_CACHE_MAX_FILE_SIZE (4 * 1024 * 1024)
+
+// Memory all cached files and their variants may take
+#define STATIC_CACHE_MAX_TOTAL (32 * 1024 * 1024)
+
+// Deepest directory below web_root that is cached
+#define STATIC_CACHE_MAX_DEPTH 8
+
+// Directory whose files have content hashes in their names (Vite assetsDir)
+#define HASHED_ASSETS_DIR "/assets/"
+
+typedef struct {
+    unsigned char *data;
+    size_t size;
+} asset_variant_t;
+
+typedef struct {
+    char *path;                 // Below web_root, starting with '/'
+    const char *content_type;
+    bool immutable;             // Name carries a content hash
+    uint64_t hash;              // FNV-1a of the uncompressed content
+    asset_variant_t identity;
+    asset_variant_t gzip;
+    asset_variant_t brotli;
+} cached_asset_t;
+
+// File types that are cached, and whether they are worth compressing
+static const struct {
+    const char *ext;
+    const char *content_type;
+    bool compressible;
+} asset_types[] = {
+    {".html", "text/html; charset=utf-8", true},
+    {".js", "application/javascript", true},
+    {".mjs", "application/javascript", true},
+    {".css", "text/css", true},
+    {".json", "application/json", true},
+    {".svg", "image/svg+xml", true},
+    {".txt", "text/plain", true},
+    {".ico", "image/x-icon", false},
+    {".png", "image/png", false},
+    {".jpg", "image/jpeg", false},
+    {".woff", "font/woff", false},
+    {".woff2", "font/woff2", false},
+};
+
+// Sorted by path; read-only once built
+static cached_asset_t *assets = NULL;
+static int asset_count = 0;
+static int asset_capacity = 0;
+static size_t cached_bytes = 0;
+
+static uint64_t hash_content(const unsigned char *data, size_t size) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static int find_asset_type(const char *name) {
+    const char *ext = strrchr(name, '.');
+    if (!ext) {
+        return -1;
+    }
+    for (size_t i = 0; i < sizeof(asset_types) / sizeof(asset_types[0]); i++) {
+        if (strcasecmp(ext, asset_types[i].ext) == 0) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Read a whole file of at most max_size bytes
+ *
+ * @return true on success, false if missing, too large or unreadable
+ */
+static bool read_file(const char *path, size_t max_size, asset_variant_t *variant) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fileno(file), &st) != 0 || !S_ISREG(st.st_mode) || (size_t)st.st_size > max_size) {
+        fclose(file);
+        return false;
+    }
+
+    size_t size = (size_t)st.st_size;
+    unsigned char *data = malloc(size ? size : 1);
+    if (!data || fread(data, 1, size, file) != size) {
+        free(data);
+        fclose(file);
+        return false;
+    }
+
+    fclose(file);
+    variant->data = data;
+    variant->size = size;
+    return true;
+}
+
+#ifdef HAVE_ZLIB
+static bool gzip_compress(const asset_variant_t *input, asset_variant_t *output) {
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    // 15 + 16: gzip wrapper instead of zlib
+    if (deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return false;
+    }
+
+    uLong bound = deflateBound(&zs, (uLong)input->size);
+    unsigned char *data = malloc(bound);
+    if (!data) {
+        deflateEnd(&zs);
+        return false;
+    }
+
+    zs.next_in = input->data;
+    zs.avail_in = (uInt)input->size;
+    zs.next_out = data;
+    zs.avail_out = (uInt)bound;
+    int rc = deflate(&zs, Z_FINISH);
+    size_t size = zs.total_out;
+    deflateEnd(&zs);
+
+    if (rc != Z_STREAM_END) {
+        free(data);
+        return false;
+    }
+
+    output->data = data;
+    output->size = size;
+    return true;
+}
+#endif
+
+// Keep a compressed variant only if it saves at least a tenth
+static void keep_if_smaller(asset_variant_t *variant, size_t original_size) {
+    if (variant->data && variant->size >= original_size - original_size / 10) {
+        free(variant->data);
+        variant->data = NULL;
+        variant->size = 0;
+    }
+}
+
+static void free_asset(cached_asset_t *asset) {
+    free(asset->path);
+    free(asset->identity.data);
+    free(asset->gzip.data);
+    free(asset->brotli.data);
+}
+
+static void cache_file(const char *file_path, const char *rel_path, int type, bool compress) {
+    if (cached_bytes >= STATIC_CACHE_MAX_TOTAL) {
+        return;
+    }
+
+    cached_asset_t asset;
+    memset(&asset, 0, sizeof(asset));
+    if (!read_file(file_path, STATIC_CACHE_MAX_FILE_SIZE, &asset.identity)) {
+        return;
+    }
+
+    if (compress && asset_types[type].compressible && asset.identity.size > 0) {
+        char variant_path[MAX_PATH_LENGTH * 2];
+
+        // Variants produced by the build are typically smaller than ours
+        snprintf(variant_path, sizeof(variant_path), "%s.br", file_path);
+        read_file(variant_path, STATIC_CACHE_MAX_FILE_SIZE, &asset.brotli);
+        snprintf(variant_path, sizeof(variant_path), "%s.gz", file_path);
+        if (!read_file(variant_path, STATIC_CACHE_MAX_FILE_SIZE, &asset.gzip)) {
+#ifdef HAVE_ZLIB
+            gzip_compress(&asset.identity, &asset.gzip);
+#endif
+        }
+
+        keep_if_smaller(&asset.brotli, asset.identity.size);
+        keep_if_smaller(&asset.gzip, asset.identity.size);
+    }
+
+    size_t size = asset.identity.size + asset.gzip.size + asset.brotli.size;
+    if (cached_bytes + size > STATIC_CACHE_MAX_TOTAL) {
+        log_debug("Static cache full, serving %s from disk", rel_path);
+        free_asset(&asset);
+        return;
+    }
+    if (!memory_budget_allows(MEMORY_TAG_WEB, size)) {
+        log_debug("Over the memory budget, serving %s from disk", rel_path);
+        free_asset(&asset);
+        return;
+    }
+
+    if (asset_count == asset_capacity) {
+        int capacity = asset_capacity ? asset_capacity * 2 : 64;
+        cached_asset_t *grown = realloc(assets, (size_t)capacity * sizeof(cached_asset_t));
+        if (!grown) {
+            free_asset(&asset);
+            return;
+        }
+        assets = grown;
+        asset_capacity = capacity;
+    }
+
+    asset.path = strdup(rel_path);
+    if (!asset.path) {
+        free_asset(&asset);
+        return;
+    }
+    asset.content_type = asset_types[type].content_type;
+    asset.immutable = strncmp(rel_path, HASHED_ASSETS_DIR, strlen(HASHED_ASSETS_DIR)) == 0;
+    asset.hash = hash_content(asset.identity.data, asset.identity.size);
+
+    assets[asset_count++] = asset;
+    cached_bytes += size;
+    memory_track(MEMORY_TAG_WEB, size, true);
+}
+
+static void scan_directory(const char *dir_path, const char *rel_dir, int depth, bool compress) {
+    DIR *dir = opendir(dir_path);
+    if (!dir) {
+        return;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        // Skips . and .. as well as hidden files
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+
+        char file_path[MAX_PATH_LENGTH * 2];
+        char rel_path[MAX_PATH_LENGTH];
+        snprintf(file_path, sizeof(file_path), "%s/%s", dir_path, entry->d_name);
+        if (snprintf(rel_path, sizeof(rel_path), "%s/%s", rel_dir, entry->d_name) >= (int)sizeof(rel_path)) {
+            continue;
+        }
+
+        struct stat st;
+        if (stat(file_path, &st) != 0) {
+            continue;
+        }
+
+        if (S_ISDIR(st.st_mode)) {
+            if (depth < STATIC_CACHE_MAX_DEPTH) {
+                scan_directory(file_path, rel_path, depth + 1, compress);
+            }
+        } else if (S_ISREG(st.st_mode)) {
+            int type = find_asset_type(entry->d_name);
+            if (type >= 0) {
+                cache_file(file_path, rel_path, type, compress);
+            }
+        }
+    }
+
+    closedir(dir);
+}
+
+static int compare_assets(const void *a, const void *b) {
+    return strcmp(((const cached_asset_t *)a)->path, ((const cached_asset_t *)b)->path);
+}
+
+int static_cache_init(const char *web_root, bool compress) {
+    static_cache_free();
+
+    if (!web_root || web_root[0] == '\0') {
+        return -1;
+    }
+
+    scan_directory(web_root, "", 0, compress);
+    if (asset_count > 0) {
+        qsort(assets, (size_t)asset_count, sizeof(cached_asset_t), compare_assets);
+    }
+
+    int compressed = 0;
+    for (int i = 0; i < asset_count; i++) {
+        if (assets[i].gzip.data || assets[i].brotli.data) {
+            compressed++;
+        }
+    }
+
+    log_info("Cached %d web files from %s in %zu KB (%d with compressed variants)",
+             asset_count, web_root, cached_bytes / 1024, compressed);
+    return asset_count;
+}
+
+void static_cache_free(void) {
+    for (int i = 0; i < asset_count; i++) {
+        free_asset(&assets[i]);
+    }
+    free(assets);
+    assets = NULL;
+    asset_count = 0;
+    asset_capacity = 0;
+    memory_track(MEMORY_TAG_WEB, cached_bytes, false);
+    cached_bytes = 0;
+}
+
+// Whether If-None-Match names any variant of the asset
+static bool etag_matches(struct mg_http_message *hm, uint64_t hash) {
+    struct mg_str *header = mg_http_get_header(hm, "If-None-Match");
+    if (!header) {
+        return false;
+    }
+
+    char buf[512];
+    size_t len = header->len < sizeof(buf) - 1 ? header->len : sizeof(buf) - 1;
+    memcpy(buf, header->buf, len);
+    buf[len] = '\0';
+
+    char tag[24];
+    snprintf(tag, sizeof(tag), "\"%016llx", (unsigned long long)hash);
+    return strstr(buf, tag) != NULL || strcmp(buf, "*") == 0;
+}
+
+static const cached_asset_t *find_asset(const char *path) {
+    cached_asset_t key = {.path = (char *)path};
+    return bsearch(&key, assets, (size_t)asset_count, sizeof(cached_asset_t), compare_assets);
+}
+
+bool static_cache_serve(struct mg_connection *c, struct mg_http_message *hm, const char *path) {
+    const cached_asset_t *asset = path ? find_asset(path) : NULL;
+    if (!asset) {
+        return false;
+    }
+
+    const asset_variant_t *body = &asset->identity;
+    const char *encoding = NULL;
+    const char *suffix = "";
+    if (asset->brotli.data && http_accepts_encoding(hm, "br")) {
+        body = &asset->brotli;
+        encoding = "br";
+        suffix = "-br";
+    } else if (asset->gzip.data && http_accepts_encoding(hm, "gzip")) {
+        body = &asset->gzip;
+        encoding = "gzip";
+        suffix = "-gz";
+    }
+
+    // Each encoding is a different representation with its own strong ETag
+    char headers[512];
+    snprintf(headers, sizeof(headers),
+             "Content-Type: %s\r\n"
+             "ETag: \"%016llx%s\"\r\n"
+             "Cache-Control: %s\r\n"
+             "%s%s%s%s"
+             "Access-Control-Allow-Origin: *\r\n",
+             asset->content_type, (unsigned long long)asset->hash, suffix,
+             asset->immutable ? "public, max-age=31536000, immutable" : "no-cache",
+             asset->gzip.data || asset->brotli.data ? "Vary: Accept-Encoding\r\n" : "",
+             encoding ? "Content-Encoding: " : "", encoding ? encoding : "", encoding ? "\r\n" : "");
+
+    if (etag_matches(hm, asset->hash)) {
+        mg_printf(c, "HTTP/1.1 304 Not Modified\r\n%sContent-Length: 0\r\n\r\n", headers);
+        return true;
+    }
+
+    mg_printf(c, "HTTP/1.1 200 OK\r\n%sContent-Length: %lu\r\n\r\n", headers, (unsigned long)body->size);
+    if (mg_strcmp(hm->method, mg_str("HEAD")) != 0) {
+        mg_send(c, body->data, body->size);
+    }
+    return true;
+}
@@ -0,0 +1,88 @@
+/**
+ * @file mongoose_server_tls.c
+ * @brief TLS setup of accepted HTTPS connections
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "web/mongoose_server_tls.h"
+#include "core/logger.h"
+#include "mongoose.h"
+
+#if MG_TLS == MG_TLS_OPENSSL
+#include <openssl/ssl.h>
+#include <openssl/bio.h>
+#include <openssl/rand.h>
+
+// Session ID context; resumed sessions must have been made with the same one
+#define TLS_SESSION_CONTEXT "lightnvr"
+
+// Mongoose gives every connection its own SSL_CTX, whose random ticket keys
+// would make a ticket useless on the next connection. These are shared by
+// all connections and live as long as the process.
+static unsigned char ticket_keys[80];
+static bool ticket_keys_ready = false;
+static pthread_once_t ticket_keys_once = PTHREAD_ONCE_INIT;
+
+static void init_ticket_keys(void) {
+    if (RAND_bytes(ticket_keys, sizeof(ticket_keys)) == 1) {
+        ticket_keys_ready = true;
+    } else {
+        log_warn("Could not generate TLS session ticket keys, sessions will not be resumed");
+    }
+}
+
+static SSL *connection_ssl(const struct mg_connection *c) {
+    struct mg_tls *tls = (struct mg_tls *)c->tls;
+    return tls ? tls->ssl : NULL;
+}
+#endif
+
+void mg_tls_setup_accepted(struct mg_connection *c, const char *cert_path, const char *key_path) {
+    if (!c->tls) {
+        struct mg_tls_opts opts = {
+            .cert = cert_path,
+            .key = key_path,
+        };
+        mg_tls_init(c, &opts);
+    }
+
+#if MG_TLS == MG_TLS_OPENSSL
+    SSL *ssl = connection_ssl(c);
+    if (!ssl) {
+        return;
+    }
+
+    pthread_once(&ticket_keys_once, init_ticket_keys);
+    if (ticket_keys_ready) {
+        SSL_CTX_set_tlsext_ticket_keys(SSL_get_SSL_CTX(ssl), ticket_keys, sizeof(ticket_keys));
+        SSL_set_session_id_context(ssl, (const unsigned char *)TLS_SESSION_CONTEXT,
+                                   strlen(TLS_SESSION_CONTEXT));
+    }
+
+#if defined(__linux__) && defined(SSL_OP_ENABLE_KTLS)
+    // OpenSSL only hands the keys to the kernel when it writes to the socket
+    // itself rather than through Mongoose's BIO. Reads still go through
+    // Mongoose, which takes the socket's data into its own buffer.
+    BIO *wbio = BIO_new_socket((int)(size_t)c->fd, BIO_NOCLOSE);
+    if (wbio) {
+        SSL_set0_wbio(ssl, wbio);
+        SSL_set_options(ssl, SSL_OP_ENABLE_KTLS);
+    }
+#endif
+#endif
+}
+
+bool mg_tls_kernel_send(const struct mg_connection *c) {
+#if MG_TLS == MG_TLS_OPENSSL && defined(__linux__) && defined(BIO_get_ktls_send)
+    SSL *ssl = connection_ssl(c);
+    return ssl && !c->is_tls_hs && BIO_get_ktls_send(SSL_get_wbio(ssl));
+#else
+    (void)c;
+    return false;
+#endif
+}
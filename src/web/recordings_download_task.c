@@ -17,9 +17,14 @@
 #include "web/mongoose_server_auth.h"
 #include "web/http_server.h"
 #include "web/api_handlers.h"
+#include "web/mongoose_server_sendfile.h"
+#include "web/api_handlers_export.h"
 #include "core/logger.h"
 #include "database/database_manager.h"
 #include "database/db_recordings.h"
+#include "database/db_compaction.h"
+#include "storage/archive_worker.h"
+#include "video/hls_recording.h"
 
 /**
  * @brief Create a download recording task
@@ -94,14 +99,52 @@ void mg_handle_download_recording(struct mg_connection *c, struct mg_http_messag
         return;
     }
     
-    // Check if file exists
+    // Check if file exists, on whichever storage tier holds it
     struct stat st;
-    if (stat(recording.file_path, &st) != 0) {
+    if (locate_recording_file(&recording, &st) != 0) {
         log_error("Recording file not found: %s", recording.file_path);
         mg_send_json_error(c, 404, "Recording file not found");
         return;
     }
     
+    // A recording compacted into a shared file is copied out of it as it is sent
+    if (get_recording_compaction(recording.id, NULL) == 1) {
+        mg_stream_compacted_recording(c, &recording, true);
+        return;
+    }
+
+    // A recording kept as HLS segments downloads as one fragmented MP4 named
+    // after its directory
+    if (hls_recording_is_segmented(recording.file_path)) {
+        char *dir_end = strrchr(recording.file_path, '/');
+        *dir_end = '\0';
+        const char *dir_name = strrchr(recording.file_path, '/');
+        dir_name = dir_name ? dir_name + 1 : recording.file_path;
+
+        char segmented_headers[512];
+        snprintf(segmented_headers, sizeof(segmented_headers),
+                 "Content-Type: video/mp4\r\n"
+                 "Content-Disposition: attachment; filename=\"%s.mp4\"\r\n",
+                 dir_name);
+        *dir_end = '/';
+
+        hls_recording_files_t files;
+        if (hls_recording_get_files(recording.id, recording.file_path, 0, &files) != 0) {
+            mg_send_json_error(c, 404, "Recording has no segments");
+            return;
+        }
+        int result = mg_serve_files_concat(c, hm, (const char *const *)files.paths, files.count,
+                                           segmented_headers);
+        hls_recording_free_files(&files);
+        if (result != 0) {
+            mg_send_json_error(c, 503, "Too many recordings being served");
+            return;
+        }
+
+        log_info("Successfully handled GET /api/recordings/download/%llu request", (unsigned long long)id);
+        return;
+    }
+
     // Extract filename from path
     const char *filename = strrchr(recording.file_path, '/');
     if (filename) {
@@ -136,14 +179,9 @@ void mg_handle_download_recording(struct mg_connection *c, struct mg_http_messag
              "Content-Disposition: attachment; filename=\"%s\"\r\n",
              content_type, filename);
     
-    // Use Mongoose's built-in file serving capability
-    struct mg_http_serve_opts opts = {
-        .mime_types = "",  // We're setting Content-Type explicitly in extra_headers
-        .extra_headers = headers
-    };
-    
-    log_debug("Serving file directly using mg_http_serve_file: %s", recording.file_path);
-    mg_http_serve_file(c, hm, recording.file_path, &opts);
+    // Send the file with sendfile, including range requests
+    log_debug("Serving file with zero-copy transfer: %s", recording.file_path);
+    mg_serve_file_zero_copy(c, hm, recording.file_path, headers);
     
     log_info("Successfully handled GET /api/recordings/download/%llu request", (unsigned long long)id);
 }
@@ -21,7 +21,13 @@
 #include "core/logger.h"
 #include "database/database_manager.h"
 #include "database/db_recordings.h"
+#include "database/db_compaction.h"
+#include "storage/archive_worker.h"
+#include "video/recording_index.h"
+#include "video/hls_recording.h"
 #include "web/mongoose_server_multithreading.h"
+#include "web/mongoose_server_sendfile.h"
+#include "web/api_handlers_export.h"
 
 /**
  * @brief Create a playback recording task
@@ -150,9 +156,9 @@ void playback_recording_task_function(void *arg) {
         return;
     }
 
-    // Check if file exists
+    // Check if file exists, on whichever storage tier holds it
     struct stat st;
-    if (stat(recording.file_path, &st) != 0) {
+    if (locate_recording_file(&recording, &st) != 0) {
         log_error("Recording file not found: %s (error: %s)", recording.file_path, strerror(errno));
         mg_http_reply(c, 404, headers, "{\"error\":\"Recording file not found\"}");
         mark_request_inactive(id);  // Mark request as inactive
@@ -160,6 +166,14 @@ void playback_recording_task_function(void *arg) {
         return;
     }
 
+    // A recording compacted into a shared file is copied out of it as it is sent
+    if (get_recording_compaction(recording.id, NULL) == 1) {
+        mg_stream_compacted_recording(c, &recording, false);
+        mark_request_inactive(id);
+        playback_recording_task_free(task, false);
+        return;
+    }
+
     log_info("Using Mongoose file serving for file: %s (%ld bytes)", recording.file_path, st.st_size);
 
     // Determine content type based on file extension
@@ -181,23 +195,79 @@ void playback_recording_task_function(void *arg) {
 
     log_info("Using content type: %s for file: %s", content_type, recording.file_path);
 
-    // Create struct mg_http_serve_opts for file serving options
-    struct mg_http_serve_opts opts = {0};
-    opts.mime_types = content_type; // Override MIME type
-    opts.extra_headers = "Accept-Ranges: bytes\r\n"
-                         "Access-Control-Allow-Origin: *\r\n"
-                         "Access-Control-Allow-Methods: GET, OPTIONS\r\n"
-                         "Access-Control-Allow-Headers: Range, Origin, Content-Type, Accept\r\n"
-                         "Cache-Control: max-age=3600\r\n";
+    // Response headers; Accept-Ranges and Content-Range are added when serving
+    char file_headers[512];
+    snprintf(file_headers, sizeof(file_headers),
+             "Content-Type: %s\r\n"
+             "Access-Control-Allow-Origin: *\r\n"
+             "Access-Control-Allow-Methods: GET, OPTIONS\r\n"
+             "Access-Control-Allow-Headers: Range, Origin, Content-Type, Accept\r\n"
+             "Cache-Control: max-age=3600\r\n",
+             content_type);
 
     // Log if this is a range request
     if (task->range_header) {
         log_info("Range request: %s", task->range_header);
     }
 
-    // Let Mongoose handle the file serving, including range requests
-    log_info("Serving file using Mongoose's built-in file server");
-    mg_http_serve_file(c, task->hm, recording.file_path, &opts);
+    // A recording kept as HLS segments is served as one fragmented MP4: its
+    // initialization section followed by the segments, from ?t=<seconds> on
+    char t_param[32];
+    if (hls_recording_is_segmented(recording.file_path)) {
+        double t = 0;
+        if (recording.is_complete &&
+            mg_http_get_var(&task->hm->query, "t", t_param, sizeof(t_param)) > 0) {
+            t = atof(t_param);
+        }
+
+        hls_recording_files_t files;
+        int result = -1;
+        if (hls_recording_get_files(recording.id, recording.file_path,
+                                    t > 0 ? (int64_t)(t * 1000.0) : 0, &files) == 0) {
+            char segmented_headers[640];
+            snprintf(segmented_headers, sizeof(segmented_headers),
+                     "%sX-Playback-Offset: %.3f\r\n"
+                     "Access-Control-Expose-Headers: X-Playback-Offset\r\n",
+                     file_headers, files.start_ms / 1000.0);
+            result = mg_serve_files_concat(c, task->hm, (const char *const *)files.paths, files.count,
+                                           t > 0 ? segmented_headers : file_headers);
+            hls_recording_free_files(&files);
+            if (result != 0) {
+                mg_http_reply(c, 503, headers, "{\"error\":\"Too many recordings being served\"}");
+            }
+        } else {
+            mg_http_reply(c, 404, headers, "{\"error\":\"Recording has no segments\"}");
+        }
+
+        mark_request_inactive(id);
+        playback_recording_task_free(task, false);
+        return;
+    }
+
+    // With ?t=<seconds>, a fragmented recording is served from the fragment covering
+    // that time: its ftyp and moov boxes followed by the file from that fragment on
+    bool served = false;
+    if (recording.is_complete &&
+        mg_http_get_var(&task->hm->query, "t", t_param, sizeof(t_param)) > 0) {
+        double t = atof(t_param);
+        recording_index_entry_t entry;
+        uint64_t init_size = 0;
+        if (t > 0 && recording_index_find(recording.file_path, (int64_t)(t * 1000.0), &entry, &init_size) == 0 &&
+            entry.offset > init_size) {
+            char spliced_headers[640];
+            snprintf(spliced_headers, sizeof(spliced_headers),
+                     "%sX-Playback-Offset: %.3f\r\n"
+                     "Access-Control-Expose-Headers: X-Playback-Offset\r\n",
+                     file_headers, entry.time_ms / 1000.0);
+            served = mg_serve_file_spliced(c, task->hm, recording.file_path, (off_t)init_size,
+                                           (off_t)entry.offset, spliced_headers) == 0;
+        }
+    }
+
+    // Send the file with sendfile, including range requests
+    if (!served) {
+        mg_serve_file_zero_copy(c, task->hm, recording.file_path, file_headers);
+    }
 
     log_info("File serving initiated");
 
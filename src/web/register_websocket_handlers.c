@@ -7,6 +7,9 @@
 #include "web/websocket_manager.h"
 #include "web/api_handlers_recordings_batch_ws.h"
 #include "web/api_handlers_system_ws.h"
+#include "web/api_handlers_detection_ws.h"
+#include "web/api_handlers_backup_ws.h"
+#include "web/api_handlers_streams_ws.h"
 #include "core/logger.h"
 
 /**
@@ -28,5 +31,18 @@ void websocket_register_handlers(void) {
     // Register system logs handler
     websocket_handler_register("system/logs", websocket_handle_system_logs);
     
+    // Register live detections handler for every "detections/<stream>" topic
+    websocket_handler_register(DETECTIONS_TOPIC_PREFIX, websocket_handle_detections);
+    if (start_live_detections() != 0) {
+        log_error("Failed to subscribe live detections to detection events");
+    }
+    
+    // Register database backup progress handler
+    websocket_handler_register(BACKUP_TOPIC, websocket_handle_backup);
+    set_backup_progress_callback(publish_backup_progress);
+
+    // Register stream status handler
+    websocket_handler_register(STREAMS_STATUS_TOPIC, websocket_handle_stream_status);
+    
     log_info("WebSocket handlers registered");
 }
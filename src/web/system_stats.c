@@ -0,0 +1,419 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/utsname.h>
+#include <sys/sysinfo.h>
+#include <sys/statvfs.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <ifaddrs.h>
+#include <net/if.h>
+
+#include "web/system_stats.h"
+#include "core/logger.h"
+#include "core/config.h"
+#include "database/db_streams.h"
+#include "database/db_recordings.h"
+#include "video/thread_utils.h"
+
+// External function from api_handlers_system_go2rtc.c
+extern bool get_go2rtc_memory_usage(unsigned long long *memory_usage);
+
+// CPU time counters from /proc/stat
+typedef struct {
+    unsigned long long busy;
+    unsigned long long total;
+} cpu_times_t;
+
+static pthread_t sampler_thread;
+static bool sampler_running = false;
+static pthread_mutex_t sampler_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sampler_cond = PTHREAD_COND_INITIALIZER;     // Signaled to stop the thread
+
+// Two snapshots: readers copy the published one while the sampler fills the
+// other, then the index is swapped. A slot is only refilled once no reader
+// that saw it published is still copying it.
+static system_stats_t slots[2];
+static atomic_int published = -1;
+static atomic_int slot_readers[2];
+
+static bool read_cpu_times(cpu_times_t *times) {
+    FILE *fp = fopen("/proc/stat", "r");
+    if (!fp) {
+        return false;
+    }
+
+    unsigned long long user = 0, nice = 0, system = 0, idle = 0;
+    unsigned long long iowait = 0, irq = 0, softirq = 0, steal = 0;
+    int fields = fscanf(fp, "cpu %llu %llu %llu %llu %llu %llu %llu %llu",
+                        &user, &nice, &system, &idle, &iowait, &irq, &softirq, &steal);
+    fclose(fp);
+    if (fields < 4) {
+        return false;
+    }
+
+    times->busy = user + nice + system + irq + softirq + steal;
+    times->total = times->busy + idle + iowait;
+    return true;
+}
+
+static unsigned long long read_process_memory(void) {
+    FILE *fp = fopen("/proc/self/status", "r");
+    if (!fp) {
+        return 0;
+    }
+
+    unsigned long long rss_kb = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), fp)) {
+        if (strncmp(line, "VmRSS:", 6) == 0) {
+            sscanf(line + 6, "%llu", &rss_kb);
+            break;
+        }
+    }
+    fclose(fp);
+    return rss_kb * 1024;
+}
+
+/**
+ * Seconds since boot at which this process started, from /proc/self/stat
+ */
+static double read_process_start(void) {
+    FILE *fp = fopen("/proc/self/stat", "r");
+    if (!fp) {
+        return -1.0;
+    }
+
+    char buf[1024];
+    size_t len = fread(buf, 1, sizeof(buf) - 1, fp);
+    fclose(fp);
+    buf[len] = '\0';
+
+    // The command name may contain spaces; fields resume after its closing parenthesis
+    char *p = strrchr(buf, ')');
+    if (!p) {
+        return -1.0;
+    }
+
+    // starttime is field 22; the state after the name is field 3
+    unsigned long long starttime = 0;
+    if (sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %*u %*u %*d %*d %*d %*d %*d %*d %llu",
+               &starttime) != 1) {
+        return -1.0;
+    }
+    return (double)starttime / (double)sysconf(_SC_CLK_TCK);
+}
+
+static double read_system_uptime(void) {
+    double uptime = 0.0;
+    FILE *fp = fopen("/proc/uptime", "r");
+    if (fp) {
+        if (fscanf(fp, "%lf", &uptime) != 1) {
+            uptime = 0.0;
+        }
+        fclose(fp);
+    }
+    return uptime;
+}
+
+/**
+ * Size of a directory tree in bytes, as reported by du
+ */
+static bool read_directory_size(const char *path, unsigned long long *size) {
+    char command[512];
+    snprintf(command, sizeof(command), "du -sb '%s' 2>/dev/null | cut -f1", path);
+    FILE *fp = popen(command, "r");
+    if (!fp) {
+        return false;
+    }
+    bool ok = fscanf(fp, "%llu", size) == 1;
+    pclose(fp);
+    return ok;
+}
+
+static void read_mac_address(const char *ifname, char *mac, size_t size) {
+    char path[256];
+    snprintf(path, sizeof(path), "/sys/class/net/%s/address", ifname);
+    snprintf(mac, size, "Unknown");
+
+    FILE *fp = fopen(path, "r");
+    if (fp) {
+        if (fgets(mac, (int)size, fp)) {
+            mac[strcspn(mac, "\n")] = '\0';
+        }
+        fclose(fp);
+    }
+}
+
+/**
+ * IPv4 interfaces other than loopback, one entry per interface
+ */
+static void read_interfaces(system_stats_t *stats) {
+    struct ifaddrs *ifaddr;
+    stats->interface_count = 0;
+
+    if (getifaddrs(&ifaddr) == 0) {
+        for (struct ifaddrs *ifa = ifaddr; ifa != NULL; ifa = ifa->ifa_next) {
+            if (!ifa->ifa_addr || ifa->ifa_addr->sa_family != AF_INET || strcmp(ifa->ifa_name, "lo") == 0) {
+                continue;
+            }
+
+            bool found = false;
+            for (int i = 0; i < stats->interface_count; i++) {
+                if (strcmp(stats->interfaces[i].name, ifa->ifa_name) == 0) {
+                    found = true;
+                    break;
+                }
+            }
+            if (found || stats->interface_count >= SYSTEM_STATS_MAX_INTERFACES) {
+                continue;
+            }
+
+            system_stats_interface_t *iface = &stats->interfaces[stats->interface_count];
+            if (getnameinfo(ifa->ifa_addr, sizeof(struct sockaddr_in), iface->address, sizeof(iface->address),
+                            NULL, 0, NI_NUMERICHOST) != 0) {
+                continue;
+            }
+            snprintf(iface->name, sizeof(iface->name), "%s", ifa->ifa_name);
+            read_mac_address(ifa->ifa_name, iface->mac, sizeof(iface->mac));
+            iface->up = (ifa->ifa_flags & IFF_UP) != 0;
+            stats->interface_count++;
+        }
+        freeifaddrs(ifaddr);
+        return;
+    }
+
+    // Fall back to /proc/net/dev if getifaddrs fails
+    FILE *fp = fopen("/proc/net/dev", "r");
+    if (!fp) {
+        return;
+    }
+
+    char line[256];
+    // Skip header lines
+    if (!fgets(line, sizeof(line), fp) || !fgets(line, sizeof(line), fp)) {
+        fclose(fp);
+        return;
+    }
+
+    while (fgets(line, sizeof(line), fp) && stats->interface_count < SYSTEM_STATS_MAX_INTERFACES) {
+        char *name = strtok(line, ":");
+        if (!name) {
+            continue;
+        }
+        while (*name == ' ') {
+            name++;
+        }
+        if (strcmp(name, "lo") == 0) {
+            continue;
+        }
+
+        system_stats_interface_t *iface = &stats->interfaces[stats->interface_count++];
+        snprintf(iface->name, sizeof(iface->name), "%s", name);
+        snprintf(iface->address, sizeof(iface->address), "Unknown");
+
+        char ip_cmd[256];
+        snprintf(ip_cmd, sizeof(ip_cmd), "ip -4 addr show %s | grep -oP '(?<=inet\\s)\\d+(\\.\\d+){3}'", name);
+        FILE *ip_fp = popen(ip_cmd, "r");
+        if (ip_fp) {
+            if (fgets(iface->address, sizeof(iface->address), ip_fp)) {
+                iface->address[strcspn(iface->address, "\n")] = '\0';
+            }
+            pclose(ip_fp);
+        }
+
+        read_mac_address(name, iface->mac, sizeof(iface->mac));
+
+        char flags_path[256];
+        snprintf(flags_path, sizeof(flags_path), "/sys/class/net/%s/flags", name);
+        FILE *flags_file = fopen(flags_path, "r");
+        if (flags_file) {
+            unsigned int flags;
+            if (fscanf(flags_file, "%x", &flags) == 1) {
+                iface->up = (flags & IFF_UP) != 0;
+            }
+            fclose(flags_file);
+        }
+    }
+    fclose(fp);
+}
+
+/**
+ * Make a sample the published snapshot
+ */
+static void publish(const system_stats_t *stats) {
+    int current = atomic_load(&published);
+    int next = current < 0 ? 0 : 1 - current;
+
+    // Readers that saw this slot published before the last swap are done within
+    // a copy; later ones see it is no longer published and do not read it
+    while (atomic_load(&slot_readers[next]) > 0) {
+        sched_yield();
+    }
+    slots[next] = *stats;
+    atomic_store(&published, next);
+}
+
+bool system_stats_get(system_stats_t *stats) {
+    if (!stats) {
+        return false;
+    }
+
+    for (;;) {
+        int current = atomic_load(&published);
+        if (current < 0) {
+            memset(stats, 0, sizeof(*stats));
+            return false;
+        }
+
+        atomic_fetch_add(&slot_readers[current], 1);
+        if (atomic_load(&published) == current) {
+            *stats = slots[current];
+            atomic_fetch_sub(&slot_readers[current], 1);
+            return true;
+        }
+        // Swapped in between; the slot may be refilled, try the new one
+        atomic_fetch_sub(&slot_readers[current], 1);
+    }
+}
+
+static void *system_stats_func(void *arg) {
+    (void)arg;
+    thread_set_identity(THREAD_CLASS_SERVICE, "stats", NULL);
+
+    system_stats_t stats;
+    memset(&stats, 0, sizeof(stats));
+
+    struct utsname system_info;
+    if (uname(&system_info) == 0) {
+        snprintf(stats.cpu_model, sizeof(stats.cpu_model), "%s", system_info.machine);
+    }
+    stats.cpu_cores = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    double process_start = read_process_start();
+
+    cpu_times_t previous = {0, 0};
+    bool have_previous = read_cpu_times(&previous);
+    time_t last_slow_sample = 0;
+
+    pthread_mutex_lock(&sampler_mutex);
+    while (sampler_running) {
+        pthread_mutex_unlock(&sampler_mutex);
+
+        // Usage over the last period, not since boot
+        cpu_times_t now;
+        bool have_now = read_cpu_times(&now);
+        if (have_now && have_previous && now.total > previous.total) {
+            stats.cpu_usage = (double)(now.busy - previous.busy) * 100.0 / (double)(now.total - previous.total);
+        }
+        if (have_now) {
+            previous = now;
+            have_previous = true;
+        }
+
+        struct sysinfo sys_info;
+        if (sysinfo(&sys_info) == 0) {
+            stats.system_memory_total = (unsigned long long)sys_info.totalram * sys_info.mem_unit;
+            stats.system_memory_free = (unsigned long long)sys_info.freeram * sys_info.mem_unit;
+        }
+        stats.process_memory = read_process_memory();
+
+        double system_uptime = read_system_uptime();
+        stats.uptime = process_start >= 0 ? system_uptime - process_start : system_uptime;
+
+        struct statvfs disk_info;
+        stats.have_disk = statvfs(g_config.storage_path, &disk_info) == 0;
+        if (stats.have_disk) {
+            stats.disk_total = (unsigned long long)disk_info.f_blocks * disk_info.f_frsize;
+            stats.disk_free = (unsigned long long)disk_info.f_bfree * disk_info.f_frsize;
+        }
+        struct statvfs root_disk_info;
+        stats.have_system_disk = statvfs("/", &root_disk_info) == 0;
+        if (stats.have_system_disk) {
+            stats.system_disk_total = (unsigned long long)root_disk_info.f_blocks * root_disk_info.f_frsize;
+            stats.system_disk_free = (unsigned long long)root_disk_info.f_bfree * root_disk_info.f_frsize;
+        }
+
+        read_interfaces(&stats);
+
+        int enabled_streams = get_enabled_stream_count();
+        if (enabled_streams >= 0) {
+            stats.enabled_streams = enabled_streams;
+        }
+        int recording_count = get_recording_count(0, 0, NULL, 0);
+        if (recording_count >= 0) {
+            stats.recording_count = recording_count;
+        }
+
+        time_t sampled = time(NULL);
+        if (sampled - last_slow_sample >= SYSTEM_STATS_SLOW_SAMPLE_SECONDS) {
+            last_slow_sample = sampled;
+
+            unsigned long long storage_used = 0;
+            if (read_directory_size(g_config.storage_path, &storage_used)) {
+                stats.storage_used = storage_used;
+            } else if (stats.have_disk) {
+                stats.storage_used = (unsigned long long)(disk_info.f_blocks - disk_info.f_bfree) * disk_info.f_frsize;
+            }
+
+            unsigned long long go2rtc_memory = 0;
+            get_go2rtc_memory_usage(&go2rtc_memory);
+            stats.go2rtc_memory = go2rtc_memory;
+        }
+
+        stats.sampled = sampled;
+        publish(&stats);
+
+        pthread_mutex_lock(&sampler_mutex);
+        if (!sampler_running) {
+            break;
+        }
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += SYSTEM_STATS_SAMPLE_SECONDS;
+        pthread_cond_timedwait(&sampler_cond, &sampler_mutex, &deadline);
+    }
+    pthread_mutex_unlock(&sampler_mutex);
+
+    return NULL;
+}
+
+int system_stats_start(void) {
+    pthread_mutex_lock(&sampler_mutex);
+    if (sampler_running) {
+        pthread_mutex_unlock(&sampler_mutex);
+        return 0;
+    }
+
+    sampler_running = true;
+    if (pthread_create(&sampler_thread, NULL, system_stats_func, NULL) != 0) {
+        log_error("Failed to start system stats sampler thread");
+        sampler_running = false;
+        pthread_mutex_unlock(&sampler_mutex);
+        return -1;
+    }
+    pthread_mutex_unlock(&sampler_mutex);
+
+    log_info("System stats sampler started (every %d seconds)", SYSTEM_STATS_SAMPLE_SECONDS);
+    return 0;
+}
+
+void system_stats_stop(void) {
+    pthread_mutex_lock(&sampler_mutex);
+    if (!sampler_running) {
+        pthread_mutex_unlock(&sampler_mutex);
+        return;
+    }
+    sampler_running = false;
+    pthread_cond_signal(&sampler_cond);
+    pthread_mutex_unlock(&sampler_mutex);
+
+    pthread_join(sampler_thread, NULL);
+    log_info("System stats sampler stopped");
+}
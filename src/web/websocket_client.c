@@ -2,20 +2,30 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
 
 #include "web/websocket_client.h"
+#include "web/mongoose_server_limits.h"
 #include "core/logger.h"
 #include "mongoose.h"
 
-// Maximum number of WebSocket clients
+// Maximum number of WebSocket clients, at most 32 for the topic bitmasks
 #define MAX_WS_CLIENTS 32
 
 // Maximum number of subscriptions per client
 #define MAX_SUBSCRIPTIONS 16
 
+// Maximum number of distinct topics with subscribers
+#define MAX_WS_TOPICS 64
+
 // Maximum topic name length
 #define MAX_TOPIC_LENGTH 64
 
+// Messages and bytes a client may have queued before its drop policy applies
+#define WS_CLIENT_QUEUE_LENGTH 64
+#define WS_CLIENT_QUEUE_BYTES (1024 * 1024)
+
 // WebSocket client structure
 typedef struct {
     char id[64];                                // Client ID
@@ -24,15 +34,253 @@ typedef struct {
     int subscription_count;                     // Number of subscriptions
     uint64_t last_activity;                     // Last activity timestamp
     bool active;                                // Whether the client is active
+    ws_message_t *queue[WS_CLIENT_QUEUE_LENGTH]; // Messages waiting to be sent
+    int queue_head;
+    int queue_count;
+    size_t queue_bytes;
+    int dropped;                                // Messages dropped since the last flush
+    bool close_pending;                         // Close on the next flush
 } ws_client_t;
 
+// Subscribers of a topic, bit i standing for s_clients[i]
+typedef struct {
+    char topic[MAX_TOPIC_LENGTH];
+    uint32_t subscribers;
+} ws_topic_t;
+
 // Global state
 static ws_client_t s_clients[MAX_WS_CLIENTS];
 static int s_client_count = 0;
+static ws_topic_t s_topics[MAX_WS_TOPICS];
+static pthread_mutex_t s_clients_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+ws_message_t *websocket_message_new(const char *data, size_t len) {
+    ws_message_t *msg = (ws_message_t *)malloc(sizeof(ws_message_t) + len);
+    if (!msg) {
+        log_error("Failed to allocate memory for WebSocket message");
+        return NULL;
+    }
+    msg->refs = 1;
+    msg->len = len;
+    memcpy(msg->data, data, len);
+    return msg;
+}
+
+void websocket_message_unref(ws_message_t *msg) {
+    if (msg && __atomic_sub_fetch(&msg->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        free(msg);
+    }
+}
+
+/**
+ * Find a client slot by ID
+ * Must be called with s_clients_mutex held.
+ */
+static int find_client_by_id(const char *client_id) {
+    for (int i = 0; i < MAX_WS_CLIENTS; i++) {
+        if (s_clients[i].active && strcmp(s_clients[i].id, client_id) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Find a client slot by connection
+ * Must be called with s_clients_mutex held.
+ */
+static int find_client_by_connection(const struct mg_connection *conn) {
+    for (int i = 0; i < MAX_WS_CLIENTS; i++) {
+        if (s_clients[i].active && s_clients[i].conn == conn) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Find the subscribers of a topic, optionally adding the topic
+ * Must be called with s_clients_mutex held.
+ */
+static ws_topic_t *find_topic(const char *topic, bool create) {
+    ws_topic_t *free_slot = NULL;
+    for (int i = 0; i < MAX_WS_TOPICS; i++) {
+        if (s_topics[i].topic[0] == '\0') {
+            if (!free_slot) {
+                free_slot = &s_topics[i];
+            }
+        } else if (strcmp(s_topics[i].topic, topic) == 0) {
+            return &s_topics[i];
+        }
+    }
+    if (!create || !free_slot) {
+        return NULL;
+    }
+    strncpy(free_slot->topic, topic, sizeof(free_slot->topic) - 1);
+    free_slot->topic[sizeof(free_slot->topic) - 1] = '\0';
+    free_slot->subscribers = 0;
+    return free_slot;
+}
+
+/**
+ * Take a client out of a topic's subscribers, forgetting the topic when
+ * nobody is left
+ * Must be called with s_clients_mutex held.
+ */
+static void unindex_subscription(int index, const char *topic) {
+    ws_topic_t *t = find_topic(topic, false);
+    if (t) {
+        t->subscribers &= ~(1u << index);
+        if (t->subscribers == 0) {
+            t->topic[0] = '\0';
+        }
+    }
+}
+
+/**
+ * Drop the oldest queued message of a client
+ * Must be called with s_clients_mutex held.
+ */
+static void drop_oldest(ws_client_t *client) {
+    ws_message_t *msg = client->queue[client->queue_head];
+    client->queue[client->queue_head] = NULL;
+    client->queue_head = (client->queue_head + 1) % WS_CLIENT_QUEUE_LENGTH;
+    client->queue_count--;
+    client->queue_bytes -= msg->len;
+    websocket_message_unref(msg);
+}
+
+/**
+ * Free a client slot with its subscriptions and queue
+ * Must be called with s_clients_mutex held.
+ */
+static void release_client(int index) {
+    ws_client_t *client = &s_clients[index];
+    for (int i = 0; i < client->subscription_count; i++) {
+        unindex_subscription(index, client->subscriptions[i]);
+    }
+    while (client->queue_count > 0) {
+        drop_oldest(client);
+    }
+    client->active = false;
+    client->conn = NULL;
+    client->subscription_count = 0;
+    client->dropped = 0;
+    client->close_pending = false;
+    s_client_count--;
+}
+
+/**
+ * Queue a message for a client, applying its drop policy if the queue is full
+ * Must be called with s_clients_mutex held.
+ */
+static bool queue_message(ws_client_t *client, ws_message_t *msg, ws_drop_policy_t policy) {
+    if (!client->conn || client->close_pending) {
+        return false;
+    }
+    
+    while (client->queue_count == WS_CLIENT_QUEUE_LENGTH ||
+           (client->queue_count > 0 && client->queue_bytes + msg->len > WS_CLIENT_QUEUE_BYTES)) {
+        if (policy == WS_DROP_CLIENT) {
+            log_warn("WebSocket client %s is not keeping up, closing it", client->id);
+            client->close_pending = true;
+            return false;
+        }
+        drop_oldest(client);
+        client->dropped++;
+    }
+    
+    int tail = (client->queue_head + client->queue_count) % WS_CLIENT_QUEUE_LENGTH;
+    __atomic_add_fetch(&msg->refs, 1, __ATOMIC_RELAXED);
+    client->queue[tail] = msg;
+    client->queue_count++;
+    client->queue_bytes += msg->len;
+    return true;
+}
+
+/**
+ * Subscribe a client to a topic, creating the client if needed
+ * Must be called with s_clients_mutex held.
+ */
+static bool subscribe_client(const char *client_id, const char *topic) {
+    log_debug("Subscribing client %s to topic: %s", client_id, topic);
+    
+    int index = find_client_by_id(client_id);
+    if (index < 0) {
+        // Client not found, create a new one
+        for (int i = 0; i < MAX_WS_CLIENTS; i++) {
+            if (!s_clients[i].active) {
+                // Found an empty slot
+                s_clients[i].active = true;
+                strncpy(s_clients[i].id, client_id, sizeof(s_clients[i].id) - 1);
+                s_clients[i].id[sizeof(s_clients[i].id) - 1] = '\0';
+                s_clients[i].subscription_count = 0;
+                s_clients[i].last_activity = mg_millis();
+                s_clients[i].queue_head = 0;
+                s_clients[i].queue_count = 0;
+                s_clients[i].queue_bytes = 0;
+                
+                // Get connection from client ID (assuming it's a pointer)
+                struct mg_connection *conn = NULL;
+                if (sscanf(client_id, "%p", &conn) == 1 && conn != NULL) {
+                    s_clients[i].conn = conn;
+                    log_debug("Successfully parsed connection pointer from client ID: %s", client_id);
+                } else {
+                    s_clients[i].conn = NULL;
+                    log_warn("Failed to parse connection pointer from client ID: %s", client_id);
+                }
+                
+                index = i;
+                s_client_count++;
+                log_info("Created new WebSocket client: %s", client_id);
+                break;
+            }
+        }
+        
+        if (index < 0) {
+            log_error("Maximum number of WebSocket clients reached");
+            return false;
+        }
+    }
+    
+    // Check if client is already subscribed to this topic
+    for (int i = 0; i < s_clients[index].subscription_count; i++) {
+        if (strcmp(s_clients[index].subscriptions[i], topic) == 0) {
+            // Already subscribed
+            return true;
+        }
+    }
+    
+    // Check if client has reached maximum number of subscriptions
+    if (s_clients[index].subscription_count >= MAX_SUBSCRIPTIONS) {
+        log_error("Maximum number of subscriptions reached for client: %s", client_id);
+        return false;
+    }
+    
+    ws_topic_t *t = find_topic(topic, true);
+    if (!t) {
+        log_error("Maximum number of WebSocket topics reached");
+        return false;
+    }
+    t->subscribers |= 1u << index;
+    
+    // Add subscription
+    strncpy(s_clients[index].subscriptions[s_clients[index].subscription_count],
+           topic, MAX_TOPIC_LENGTH - 1);
+    s_clients[index].subscriptions[s_clients[index].subscription_count][MAX_TOPIC_LENGTH - 1] = '\0';
+    s_clients[index].subscription_count++;
+    
+    // Update activity timestamp
+    s_clients[index].last_activity = mg_millis();
+    
+    log_info("Client %s subscribed to topic: %s", client_id, topic);
+    
+    return true;
+}
 
 /**
  * @brief Find a client by ID
- * 
+ *
  * @param client_id Client ID
  * @return int Client index or -1 if not found
  */
@@ -41,18 +289,16 @@ int websocket_client_find_by_id(const char *client_id) {
         return -1;
     }
     
-    for (int i = 0; i < MAX_WS_CLIENTS; i++) {
-        if (s_clients[i].active && strcmp(s_clients[i].id, client_id) == 0) {
-            return i;
-        }
-    }
+    pthread_mutex_lock(&s_clients_mutex);
+    int index = find_client_by_id(client_id);
+    pthread_mutex_unlock(&s_clients_mutex);
     
-    return -1;
+    return index;
 }
 
 /**
  * @brief Find a client by connection
- * 
+ *
  * @param conn Mongoose connection
  * @return int Client index or -1 if not found
  */
@@ -61,40 +307,41 @@ int websocket_client_find_by_connection(const struct mg_connection *conn) {
         return -1;
     }
     
-    for (int i = 0; i < MAX_WS_CLIENTS; i++) {
-        if (s_clients[i].active && s_clients[i].conn == conn) {
-            return i;
-        }
-    }
+    pthread_mutex_lock(&s_clients_mutex);
+    int index = find_client_by_connection(conn);
+    pthread_mutex_unlock(&s_clients_mutex);
     
-    return -1;
+    return index;
 }
 
 /**
  * @brief Remove a client by connection
- * 
+ *
  * @param conn Mongoose connection
  * @return bool true if client was removed, false otherwise
  */
 bool websocket_client_remove_by_connection(const struct mg_connection *conn) {
-    int index = websocket_client_find_by_connection(conn);
-    if (index < 0) {
+    if (!conn) {
         return false;
     }
     
-    // Mark client as inactive
-    s_clients[index].active = false;
-    s_clients[index].conn = NULL;
-    s_clients[index].subscription_count = 0;
+    pthread_mutex_lock(&s_clients_mutex);
+    int index = find_client_by_connection(conn);
+    if (index < 0) {
+        pthread_mutex_unlock(&s_clients_mutex);
+        return false;
+    }
     
+    release_client(index);
     log_info("Removed WebSocket client: %s", s_clients[index].id);
+    pthread_mutex_unlock(&s_clients_mutex);
     
     return true;
 }
 
 /**
  * @brief Check if a client is subscribed to a topic
- * 
+ *
  * @param client_id Client ID
  * @param topic Topic to check
  * @return bool true if subscribed, false otherwise
@@ -111,29 +358,26 @@ bool websocket_client_is_subscribed(const char *client_id, const char *topic) {
         return false;
     }
     
-    int index = websocket_client_find_by_id(client_id);
-    if (index < 0) {
-        // Client not found, but we'll auto-subscribe them
-        log_info("Client %s not found, auto-subscribing to topic: %s", client_id, topic);
-        websocket_client_subscribe(client_id, topic);
-        return true;  // Return true to allow the operation to proceed
-    }
-    
-    for (int i = 0; i < s_clients[index].subscription_count; i++) {
-        if (strcmp(s_clients[index].subscriptions[i], topic) == 0) {
+    pthread_mutex_lock(&s_clients_mutex);
+    int index = find_client_by_id(client_id);
+    if (index >= 0) {
+        ws_topic_t *t = find_topic(topic, false);
+        if (t && (t->subscribers & (1u << index))) {
+            pthread_mutex_unlock(&s_clients_mutex);
             return true;
         }
     }
     
-    // Client found but not subscribed, auto-subscribe them
-    log_info("Client %s found but not subscribed to topic: %s, auto-subscribing", client_id, topic);
-    websocket_client_subscribe(client_id, topic);
+    // Not subscribed yet, auto-subscribe them
+    log_info("Client %s not subscribed to topic: %s, auto-subscribing", client_id, topic);
+    subscribe_client(client_id, topic);
+    pthread_mutex_unlock(&s_clients_mutex);
     return true;  // Return true to allow the operation to proceed
 }
 
 /**
  * @brief Get all clients subscribed to a topic
- * 
+ *
  * @param topic Topic to check
  * @param client_ids Pointer to array of client IDs (will be allocated)
  * @return int Number of clients subscribed to the topic
@@ -143,23 +387,15 @@ int websocket_client_get_subscribed(const char *topic, char ***client_ids) {
         return 0;
     }
     
-    // Count subscribed clients
-    int count = 0;
-    for (int i = 0; i < MAX_WS_CLIENTS; i++) {
-        if (!s_clients[i].active) {
-            continue;
-        }
-        
-        for (int j = 0; j < s_clients[i].subscription_count; j++) {
-            if (strcmp(s_clients[i].subscriptions[j], topic) == 0) {
-                count++;
-                break;
-            }
-        }
-    }
+    *client_ids = NULL;
+    
+    pthread_mutex_lock(&s_clients_mutex);
+    ws_topic_t *t = find_topic(topic, false);
+    uint32_t subscribers = t ? t->subscribers : 0;
+    int count = __builtin_popcount(subscribers);
     
     if (count == 0) {
-        *client_ids = NULL;
+        pthread_mutex_unlock(&s_clients_mutex);
         return 0;
     }
     
@@ -167,42 +403,38 @@ int websocket_client_get_subscribed(const char *topic, char ***client_ids) {
     *client_ids = (char **)malloc(count * sizeof(char *));
     if (!*client_ids) {
         log_error("Failed to allocate memory for client IDs");
+        pthread_mutex_unlock(&s_clients_mutex);
         return 0;
     }
     
     // Fill array with client IDs
     int index = 0;
-    for (int i = 0; i < MAX_WS_CLIENTS; i++) {
-        if (!s_clients[i].active) {
+    for (int i = 0; i < MAX_WS_CLIENTS && index < count; i++) {
+        if (!(subscribers & (1u << i))) {
             continue;
         }
-        
-        for (int j = 0; j < s_clients[i].subscription_count; j++) {
-            if (strcmp(s_clients[i].subscriptions[j], topic) == 0) {
-                (*client_ids)[index] = strdup(s_clients[i].id);
-                if (!(*client_ids)[index]) {
-                    log_error("Failed to allocate memory for client ID");
-                    // Free already allocated IDs
-                    for (int k = 0; k < index; k++) {
-                        free((*client_ids)[k]);
-                    }
-                    free(*client_ids);
-                    *client_ids = NULL;
-                    return 0;
-                }
-                
-                index++;
-                break;
+        (*client_ids)[index] = strdup(s_clients[i].id);
+        if (!(*client_ids)[index]) {
+            log_error("Failed to allocate memory for client ID");
+            // Free already allocated IDs
+            for (int k = 0; k < index; k++) {
+                free((*client_ids)[k]);
             }
+            free(*client_ids);
+            *client_ids = NULL;
+            pthread_mutex_unlock(&s_clients_mutex);
+            return 0;
         }
+        index++;
     }
+    pthread_mutex_unlock(&s_clients_mutex);
     
     return count;
 }
 
 /**
  * @brief Subscribe a client to a topic
- * 
+ *
  * @param client_id Client ID
  * @param topic Topic to subscribe to
  * @return bool true on success, false on error
@@ -213,74 +445,16 @@ bool websocket_client_subscribe(const char *client_id, const char *topic) {
         return false;
     }
     
-    log_debug("Subscribing client %s to topic: %s", client_id, topic);
-    
-    int index = websocket_client_find_by_id(client_id);
-    if (index < 0) {
-        // Client not found, create a new one
-        for (int i = 0; i < MAX_WS_CLIENTS; i++) {
-            if (!s_clients[i].active) {
-                // Found an empty slot
-                s_clients[i].active = true;
-                strncpy(s_clients[i].id, client_id, sizeof(s_clients[i].id) - 1);
-                s_clients[i].id[sizeof(s_clients[i].id) - 1] = '\0';
-                s_clients[i].subscription_count = 0;
-                s_clients[i].last_activity = mg_millis();
-                
-                // Get connection from client ID (assuming it's a pointer)
-                struct mg_connection *conn = NULL;
-                if (sscanf(client_id, "%p", &conn) == 1 && conn != NULL) {
-                    s_clients[i].conn = conn;
-                    log_debug("Successfully parsed connection pointer from client ID: %s", client_id);
-                } else {
-                    s_clients[i].conn = NULL;
-                    log_warn("Failed to parse connection pointer from client ID: %s", client_id);
-                }
-                
-                index = i;
-                s_client_count++;
-                log_info("Created new WebSocket client: %s", client_id);
-                break;
-            }
-        }
-        
-        if (index < 0) {
-            log_error("Maximum number of WebSocket clients reached");
-            return false;
-        }
-    }
-    
-    // Check if client is already subscribed to this topic
-    for (int i = 0; i < s_clients[index].subscription_count; i++) {
-        if (strcmp(s_clients[index].subscriptions[i], topic) == 0) {
-            // Already subscribed
-            return true;
-        }
-    }
-    
-    // Check if client has reached maximum number of subscriptions
-    if (s_clients[index].subscription_count >= MAX_SUBSCRIPTIONS) {
-        log_error("Maximum number of subscriptions reached for client: %s", client_id);
-        return false;
-    }
-    
-    // Add subscription
-    strncpy(s_clients[index].subscriptions[s_clients[index].subscription_count], 
-           topic, MAX_TOPIC_LENGTH - 1);
-    s_clients[index].subscriptions[s_clients[index].subscription_count][MAX_TOPIC_LENGTH - 1] = '\0';
-    s_clients[index].subscription_count++;
+    pthread_mutex_lock(&s_clients_mutex);
+    bool result = subscribe_client(client_id, topic);
+    pthread_mutex_unlock(&s_clients_mutex);
     
-    // Update activity timestamp
-    s_clients[index].last_activity = mg_millis();
-    
-    log_info("Client %s subscribed to topic: %s", client_id, topic);
-    
-    return true;
+    return result;
 }
 
 /**
  * @brief Unsubscribe a client from a topic
- * 
+ *
  * @param client_id Client ID
  * @param topic Topic to unsubscribe from
  * @return bool true on success, false on error
@@ -290,8 +464,10 @@ bool websocket_client_unsubscribe(const char *client_id, const char *topic) {
         return false;
     }
     
-    int index = websocket_client_find_by_id(client_id);
+    pthread_mutex_lock(&s_clients_mutex);
+    int index = find_client_by_id(client_id);
     if (index < 0) {
+        pthread_mutex_unlock(&s_clients_mutex);
         return false;
     }
     
@@ -306,9 +482,12 @@ bool websocket_client_unsubscribe(const char *client_id, const char *topic) {
     
     if (sub_index < 0) {
         // Not subscribed
+        pthread_mutex_unlock(&s_clients_mutex);
         return false;
     }
     
+    unindex_subscription(index, topic);
+    
     // Remove subscription by shifting remaining subscriptions
     for (int i = sub_index; i < s_clients[index].subscription_count - 1; i++) {
         strcpy(s_clients[index].subscriptions[i], s_clients[index].subscriptions[i + 1]);
@@ -318,6 +497,7 @@ bool websocket_client_unsubscribe(const char *client_id, const char *topic) {
     
     // Update activity timestamp
     s_clients[index].last_activity = mg_millis();
+    pthread_mutex_unlock(&s_clients_mutex);
     
     log_info("Client %s unsubscribed from topic: %s", client_id, topic);
     
@@ -326,7 +506,7 @@ bool websocket_client_unsubscribe(const char *client_id, const char *topic) {
 
 /**
  * @brief Update client activity timestamp
- * 
+ *
  * @param client_id Client ID
  */
 void websocket_client_update_activity(const char *client_id) {
@@ -334,12 +514,12 @@ void websocket_client_update_activity(const char *client_id) {
         return;
     }
     
-    int index = websocket_client_find_by_id(client_id);
-    if (index < 0) {
-        return;
+    pthread_mutex_lock(&s_clients_mutex);
+    int index = find_client_by_id(client_id);
+    if (index >= 0) {
+        s_clients[index].last_activity = mg_millis();
     }
-    
-    s_clients[index].last_activity = mg_millis();
+    pthread_mutex_unlock(&s_clients_mutex);
 }
 
 /**
@@ -349,20 +529,19 @@ void websocket_client_cleanup_inactive(void) {
     uint64_t now = mg_millis();
     uint64_t timeout = 300000; // 5 minutes
     
+    pthread_mutex_lock(&s_clients_mutex);
     for (int i = 0; i < MAX_WS_CLIENTS; i++) {
         if (s_clients[i].active && (now - s_clients[i].last_activity) > timeout) {
             log_info("Removing inactive WebSocket client: %s", s_clients[i].id);
-            s_clients[i].active = false;
-            s_clients[i].conn = NULL;
-            s_clients[i].subscription_count = 0;
-            s_client_count--;
+            release_client(i);
         }
     }
+    pthread_mutex_unlock(&s_clients_mutex);
 }
 
 /**
  * @brief Get client connection by ID
- * 
+ *
  * @param client_id Client ID
  * @return struct mg_connection* Connection or NULL if not found
  */
@@ -371,10 +550,73 @@ struct mg_connection* websocket_client_get_connection(const char *client_id) {
         return NULL;
     }
     
-    int index = websocket_client_find_by_id(client_id);
-    if (index < 0) {
-        return NULL;
+    pthread_mutex_lock(&s_clients_mutex);
+    int index = find_client_by_id(client_id);
+    struct mg_connection *conn = index >= 0 ? s_clients[index].conn : NULL;
+    pthread_mutex_unlock(&s_clients_mutex);
+    
+    return conn;
+}
+
+int websocket_client_queue_topic(const char *topic, ws_message_t *msg, ws_drop_policy_t policy) {
+    if (!topic || !msg) {
+        return 0;
     }
     
-    return s_clients[index].conn;
+    int count = 0;
+    pthread_mutex_lock(&s_clients_mutex);
+    ws_topic_t *t = find_topic(topic, false);
+    uint32_t subscribers = t ? t->subscribers : 0;
+    for (int i = 0; subscribers != 0; i++, subscribers >>= 1) {
+        if ((subscribers & 1u) && queue_message(&s_clients[i], msg, policy)) {
+            count++;
+        }
+    }
+    pthread_mutex_unlock(&s_clients_mutex);
+    
+    return count;
+}
+
+bool websocket_client_queue_connection(const struct mg_connection *conn, ws_message_t *msg,
+                                       ws_drop_policy_t policy) {
+    if (!conn || !msg) {
+        return false;
+    }
+
+    pthread_mutex_lock(&s_clients_mutex);
+    int index = find_client_by_connection(conn);
+    bool queued = index >= 0 && queue_message(&s_clients[index], msg, policy);
+    pthread_mutex_unlock(&s_clients_mutex);
+
+    return queued;
+}
+
+void websocket_client_flush(struct mg_mgr *mgr) {
+    pthread_mutex_lock(&s_clients_mutex);
+    for (int i = 0; i < MAX_WS_CLIENTS; i++) {
+        ws_client_t *client = &s_clients[i];
+        if (!client->active || !client->conn || client->conn->mgr != mgr) {
+            continue;
+        }
+        
+        if (client->close_pending) {
+            mg_ws_send(client->conn, "", 0, WEBSOCKET_OP_CLOSE);
+            client->conn->is_draining = 1;
+            release_client(i);
+            continue;
+        }
+        
+        if (client->dropped > 0) {
+            log_debug("Dropped %d WebSocket messages for slow client %s", client->dropped, client->id);
+            client->dropped = 0;
+        }
+        
+        // Leave the rest queued until the socket has taken what was sent
+        while (client->queue_count > 0 && client->conn->send.len < mg_send_limit()) {
+            ws_message_t *msg = client->queue[client->queue_head];
+            mg_ws_send(client->conn, msg->data, msg->len, WEBSOCKET_OP_TEXT);
+            drop_oldest(client);
+        }
+    }
+    pthread_mutex_unlock(&s_clients_mutex);
 }
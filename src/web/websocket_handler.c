@@ -99,6 +99,16 @@ int websocket_handler_find_by_topic(const char *topic) {
         }
     }
     
+    // A topic registered with a trailing slash handles every topic under it,
+    // e.g. "detections/" handles "detections/<stream>"
+    for (int i = 0; i < MAX_WS_HANDLERS; i++) {
+        size_t len = strlen(s_handlers[i].topic);
+        if (s_handlers[i].active && len > 0 && s_handlers[i].topic[len - 1] == '/' &&
+            strncmp(s_handlers[i].topic, topic, len) == 0) {
+            return i;
+        }
+    }
+    
     return -1;
 }
 
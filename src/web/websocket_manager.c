@@ -3,9 +3,12 @@
 #include <string.h>
 #include <pthread.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "web/websocket_manager.h"
 #include "web/websocket_handler.h"
+#include "web/websocket_client.h"
+#include "web/mongoose_server_limits.h"
 #include "core/logger.h"
 #include "core/shutdown_coordinator.h"
 
@@ -18,6 +21,7 @@
 // WebSocket handler structure
 typedef struct {
     char topic[MAX_TOPIC_LENGTH];
+    uint32_t topic_hash;          // Compared before the topic itself
     websocket_handler_t handler;
     void *user_data;
     bool active;
@@ -32,6 +36,17 @@ static pthread_mutex_t s_handlers_mutex = PTHREAD_MUTEX_INITIALIZER;
 static ws_handler_entry_t s_handlers[MAX_WS_HANDLERS];
 static int s_handler_count = 0;
 
+/**
+ * @brief Hash a topic name (FNV-1a)
+ */
+static uint32_t hash_topic(const char *topic) {
+    uint32_t hash = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)topic; *p; p++) {
+        hash = (hash ^ *p) * 16777619u;
+    }
+    return hash;
+}
+
 /**
  * @brief Find a WebSocket handler by topic
  * 
@@ -39,8 +54,10 @@ static int s_handler_count = 0;
  * @return int Index of handler or -1 if not found
  */
 static int find_handler_by_topic(const char *topic) {
+    uint32_t hash = hash_topic(topic);
     for (int i = 0; i < MAX_WS_HANDLERS; i++) {
-        if (s_handlers[i].active && strcmp(s_handlers[i].topic, topic) == 0) {
+        if (s_handlers[i].active && s_handlers[i].topic_hash == hash &&
+            strcmp(s_handlers[i].topic, topic) == 0) {
             return i;
         }
     }
@@ -251,6 +268,7 @@ int websocket_manager_register_handler(const char *topic, websocket_handler_t ha
     // Add handler
     strncpy(s_handlers[slot].topic, topic, sizeof(s_handlers[slot].topic) - 1);
     s_handlers[slot].topic[sizeof(s_handlers[slot].topic) - 1] = '\0';
+    s_handlers[slot].topic_hash = hash_topic(s_handlers[slot].topic);
     s_handlers[slot].handler = handler;
     s_handlers[slot].user_data = user_data;
     s_handlers[slot].active = true;
@@ -368,8 +386,8 @@ int websocket_manager_broadcast(struct mg_mgr *mgr, const char *data, size_t dat
     
     // Traverse all connections and send to WebSocket clients
     for (struct mg_connection *c = mgr->conns; c != NULL; c = c->next) {
-        // Check if this is a WebSocket client
-        if (c->data[0] == 'W') {
+        // Check if this is a WebSocket client that keeps up
+        if (c->data[0] == 'W' && c->send.len < mg_send_limit()) {
             // Send message
             mg_ws_send(c, data, data_len, WEBSOCKET_OP_TEXT);
             count++;
@@ -378,3 +396,61 @@ int websocket_manager_broadcast(struct mg_mgr *mgr, const char *data, size_t dat
     
     return count;
 }
+
+/**
+ * @brief Publish a message to the subscribers of a topic
+ * 
+ * @param topic Topic name
+ * @param data Message data
+ * @param data_len Message data length
+ * @param policy What to do for subscribers whose queue is full
+ * @return int Number of clients the message was queued for
+ */
+int websocket_manager_publish(const char *topic, const char *data, size_t data_len, ws_drop_policy_t policy) {
+    if (!topic || !data) {
+        log_error("Invalid parameters for WebSocket publish");
+        return 0;
+    }
+    
+    ws_message_t *msg = websocket_message_new(data, data_len);
+    if (!msg) {
+        return 0;
+    }
+    int count = websocket_client_queue_topic(topic, msg, policy);
+    websocket_message_unref(msg);
+    
+    return count;
+}
+
+/**
+ * @brief Queue a message for the client of one connection
+ * 
+ * @param c Mongoose connection, which may already be closed
+ * @param data Message data
+ * @param data_len Message data length
+ * @param policy What to do if the client's queue is full
+ * @return bool true if the message was queued
+ */
+bool websocket_manager_send(const struct mg_connection *c, const char *data, size_t data_len,
+                            ws_drop_policy_t policy) {
+    if (!c || !data) {
+        log_error("Invalid parameters for WebSocket send");
+        return false;
+    }
+    
+    ws_message_t *msg = websocket_message_new(data, data_len);
+    if (!msg) {
+        return false;
+    }
+    bool queued = websocket_client_queue_connection(c, msg, policy);
+    websocket_message_unref(msg);
+    
+    return queued;
+}
+
+/**
+ * @brief Send queued messages
+ */
+void websocket_manager_flush(struct mg_mgr *mgr) {
+    websocket_client_flush(mgr);
+}
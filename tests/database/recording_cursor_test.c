@@ -0,0 +1,101 @@
+// The checks must also run in release builds
+#undef NDEBUG
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <assert.h>
+
+#include "database/db_recordings.h"
+
+// Cursors survive formatting and parsing unchanged
+static void test_round_trip(void) {
+    static const recording_cursor_t cursors[] = {
+        { 0, 0 },
+        { 0, 1 },
+        { 1700000000, 42 },
+        { 1767225600, 123456789 },
+        { (time_t)0x7fffffff, 0xabcdef },
+        { (time_t)INT64_MAX, (uint64_t)INT64_MAX },
+    };
+
+    for (size_t i = 0; i < sizeof(cursors) / sizeof(cursors[0]); i++) {
+        char token[RECORDING_CURSOR_SIZE];
+        format_recording_cursor(&cursors[i], token, sizeof(token));
+        assert(strlen(token) < RECORDING_CURSOR_SIZE);
+
+        recording_cursor_t parsed = { -1, 0 };
+        assert(parse_recording_cursor(token, &parsed) == 0);
+        assert(parsed.start_time == cursors[i].start_time);
+        assert(parsed.id == cursors[i].id);
+    }
+
+    // The format is fixed, clients may have tokens from earlier versions
+    char token[RECORDING_CURSOR_SIZE];
+    recording_cursor_t cursor = { 1700000000, 42 };
+    format_recording_cursor(&cursor, token, sizeof(token));
+    assert(strcmp(token, "6553f100.2a") == 0);
+
+    // Upper case digits and leading zeros are accepted too
+    assert(parse_recording_cursor("6553F100.002A", &cursor) == 0);
+    assert(cursor.start_time == 1700000000 && cursor.id == 42);
+
+    printf("Round trip test passed\n");
+}
+
+// Anything but two runs of 1-16 hex digits joined by a dot is rejected,
+// and the cursor is left alone
+static void test_malformed(void) {
+    static const char *tokens[] = {
+        "",
+        ".",
+        "1",
+        "1.",
+        ".1",
+        "1..2",
+        "1.2.3",
+        "1.2x",
+        "x1.2",
+        "1.g",
+        " 1.2",
+        "1.2 ",
+        "1 .2",
+        "-1.2",
+        "1.-2",
+        "+1.2",
+        "0x1.2",
+        "1.0x2",
+        "1,2",
+        "1.2\n",
+        "00000000000000001.2",      // 17 digits
+        "1.10000000000000000",      // 17 digits
+        "8000000000000000.1",       // Past INT64_MAX
+        "1.ffffffffffffffff",
+    };
+
+    for (size_t i = 0; i < sizeof(tokens) / sizeof(tokens[0]); i++) {
+        recording_cursor_t cursor = { 77, 88 };
+        if (parse_recording_cursor(tokens[i], &cursor) != -1) {
+            printf("Accepted malformed cursor \"%s\"\n", tokens[i]);
+            assert(0);
+        }
+        assert(cursor.start_time == 77 && cursor.id == 88);
+    }
+
+    recording_cursor_t cursor;
+    assert(parse_recording_cursor(NULL, &cursor) == -1);
+    assert(parse_recording_cursor("1.2", NULL) == -1);
+
+    printf("Malformed cursor test passed\n");
+}
+
+int main(void) {
+    printf("=== Recording Cursor Test ===\n");
+    test_round_trip();
+    test_malformed();
+
+    printf("All tests passed!\n");
+    return 0;
+}
@@ -0,0 +1,197 @@
+// The checks must also run in release builds
+#undef NDEBUG
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "sod/sod.h"
+
+/**
+ * Test program for the SOD NMS kernels
+ *
+ * Runs every NMS variant the CPU supports against a plain greedy NMS with
+ * the same overlap test, over box counts that hit every tail length of the
+ * 4- and 8-wide kernels and the per-class top-K limit.
+ */
+
+#define MAX_VARIANTS 8
+#define MAX_BOXES 300
+
+// Candidates per class that take part in NMS, as in sod.c
+#define NMS_TOPK 256
+
+static unsigned int random_state = 4242;
+
+static int random_int(int max) {
+    random_state = random_state * 1103515245u + 12345u;
+    return (int)((random_state >> 8) % (unsigned int)max);
+}
+
+typedef struct {
+    float score;
+    int index;
+} candidate_t;
+
+static int compare_candidates(const void *pa, const void *pb) {
+    float a = ((const candidate_t *)pa)->score;
+    float b = ((const candidate_t *)pb)->score;
+    return a < b ? 1 : a > b ? -1 : 0;
+}
+
+// Greedy NMS over the best NMS_TOPK boxes with a score above 0
+static int reference_nms(const sod_box *boxes, float *scores, int count, float thresh) {
+    candidate_t candidates[MAX_BOXES];
+    int n = 0;
+    for (int i = 0; i < count; i++) {
+        if (scores[i] > 0) {
+            candidates[n].score = scores[i];
+            candidates[n].index = i;
+            n++;
+        }
+    }
+    qsort(candidates, n, sizeof(candidate_t), compare_candidates);
+    for (int i = NMS_TOPK; i < n; i++) {
+        scores[candidates[i].index] = 0;
+    }
+    if (n > NMS_TOPK) {
+        n = NMS_TOPK;
+    }
+
+    for (int i = 0; i < n; i++) {
+        const sod_box *a = &boxes[candidates[i].index];
+        if (scores[candidates[i].index] == 0) {
+            continue;
+        }
+        for (int j = i + 1; j < n; j++) {
+            const sod_box *b = &boxes[candidates[j].index];
+            float w = (float)((a->x + a->w < b->x + b->w ? a->x + a->w : b->x + b->w) - (a->x > b->x ? a->x : b->x));
+            float h = (float)((a->y + a->h < b->y + b->h ? a->y + a->h : b->y + b->h) - (a->y > b->y ? a->y : b->y));
+            if (w < 0 || h < 0) {
+                continue;
+            }
+            float inter = w * h;
+            float area_a = (float)a->w * (float)a->h;
+            float area_b = (float)b->w * (float)b->h;
+            if (inter > thresh * (area_a + area_b - inter)) {
+                scores[candidates[j].index] = 0;
+            }
+        }
+    }
+
+    int kept = 0;
+    for (int i = 0; i < count; i++) {
+        if (scores[i] > 0) {
+            kept++;
+        }
+    }
+    return kept;
+}
+
+// Boxes scattered around a few centres, so many of them overlap
+static void make_boxes(sod_box *boxes, float *scores, int count) {
+    int centres = 1 + count / 8;
+    for (int i = 0; i < count; i++) {
+        int centre = random_int(centres);
+        memset(&boxes[i], 0, sizeof(sod_box));
+        boxes[i].x = 40 * centre + random_int(24);
+        boxes[i].y = 30 * (centre % 5) + random_int(24);
+        boxes[i].w = 8 + random_int(40);
+        boxes[i].h = 8 + random_int(40);
+        // Distinct scores, so the order of the candidates is well defined; some left out
+        scores[i] = random_int(6) == 0 ? 0.0f : (float)(1 + (i * 7919) % count) / (float)(count + 1);
+    }
+}
+
+static int test_random(const char *variant) {
+    static const float thresholds[] = { 0.3f, 0.45f, 0.7f };
+    sod_box boxes[MAX_BOXES];
+    float scores[MAX_BOXES];
+    float expected[MAX_BOXES];
+    int mismatches = 0;
+
+    for (int count = 1; count <= MAX_BOXES; count += (count < 40 ? 1 : 13)) {
+        for (size_t t = 0; t < sizeof(thresholds) / sizeof(thresholds[0]); t++) {
+            make_boxes(boxes, scores, count);
+            memcpy(expected, scores, count * sizeof(float));
+            int expected_kept = reference_nms(boxes, expected, count, thresholds[t]);
+
+            int kept = sod_kernel_nms(boxes, scores, count, thresholds[t]);
+            if (kept != expected_kept || memcmp(scores, expected, count * sizeof(float)) != 0) {
+                printf("Mismatch: %s with %d boxes at threshold %.2f (kept %d, expected %d)\n",
+                       variant, count, thresholds[t], kept, expected_kept);
+                mismatches++;
+            }
+        }
+    }
+    return mismatches;
+}
+
+static void test_cases(void) {
+    sod_box boxes[MAX_BOXES];
+    float scores[MAX_BOXES];
+    memset(boxes, 0, sizeof(boxes));
+
+    // The same box twice: only the better one stays
+    boxes[0] = (sod_box){ .x = 10, .y = 10, .w = 20, .h = 20 };
+    boxes[1] = boxes[0];
+    scores[0] = 0.6f;
+    scores[1] = 0.9f;
+    assert(sod_kernel_nms(boxes, scores, 2, 0.5f) == 1);
+    assert(scores[0] == 0.0f && scores[1] == 0.9f);
+
+    // Boxes that only touch do not overlap
+    boxes[1] = (sod_box){ .x = 30, .y = 10, .w = 20, .h = 20 };
+    scores[0] = 0.6f;
+    scores[1] = 0.9f;
+    assert(sod_kernel_nms(boxes, scores, 2, 0.0f) == 2);
+
+    // A small box inside a large one overlaps it by 1/16, and suppresses it below that
+    boxes[1] = (sod_box){ .x = 15, .y = 15, .w = 5, .h = 5 };
+    assert(sod_kernel_nms(boxes, scores, 2, 0.5f) == 2);
+    assert(sod_kernel_nms(boxes, scores, 2, 0.05f) == 1);
+    assert(scores[0] == 0.0f && scores[1] == 0.9f);
+
+    // A box without a score neither suppresses nor counts
+    boxes[1] = boxes[0];
+    scores[0] = 0.0f;
+    scores[1] = 0.5f;
+    assert(sod_kernel_nms(boxes, scores, 2, 0.5f) == 1);
+    assert(scores[1] == 0.5f);
+
+    // Only the best NMS_TOPK candidates can be kept
+    for (int i = 0; i < MAX_BOXES; i++) {
+        boxes[i] = (sod_box){ .x = 10 * i, .y = 0, .w = 5, .h = 5 };
+        scores[i] = (float)(i + 1) / (MAX_BOXES + 1);
+    }
+    assert(sod_kernel_nms(boxes, scores, MAX_BOXES, 0.5f) == NMS_TOPK);
+    for (int i = 0; i < MAX_BOXES; i++) {
+        assert((scores[i] > 0) == (i >= MAX_BOXES - NMS_TOPK));
+    }
+
+    assert(sod_kernel_nms(boxes, scores, 0, 0.5f) == 0);
+}
+
+int main(void) {
+    const char *variants[MAX_VARIANTS];
+    int count = sod_kernel_variants("nms", variants, MAX_VARIANTS);
+    assert(count >= 1);
+    assert(sod_kernel_use("nms", "no-such-variant") == SOD_UNSUPPORTED);
+
+    int mismatches = 0;
+    for (int v = 0; v < count; v++) {
+        printf("Testing NMS variant %s\n", variants[v]);
+        assert(sod_kernel_use("nms", variants[v]) == SOD_OK);
+        test_cases();
+        mismatches += test_random(variants[v]);
+    }
+    assert(sod_kernel_use("nms", NULL) == SOD_OK);
+
+    if (mismatches > 0) {
+        printf("%d mismatches\n", mismatches);
+        return 1;
+    }
+    printf("All tests passed!\n");
+    return 0;
+}
@@ -0,0 +1,139 @@
+// The checks must also run in release builds
+#undef NDEBUG
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <assert.h>
+
+#include "video/handle_table.h"
+
+#define FLAG_PENDING 0x1u
+#define FLAG_EXITED 0x2u
+
+#define STRESS_THREADS 4
+#define STRESS_ROUNDS 100000
+
+static handle_table_t table;
+
+// A released handle is rejected by every operation, even once its slot and
+// pointer are reused
+static void test_stale_handle(void) {
+    memset(&table, 0, sizeof(table));
+    int context = 0;
+
+    handle_t handle = handle_table_insert(&table, &context);
+    assert(handle != HANDLE_INVALID);
+    assert(handle_table_is_valid(&table, handle));
+    assert(handle_table_get(&table, handle) == &context);
+    assert(handle_table_find(&table, &context) == handle);
+    assert(handle_table_set_flags(&table, handle, FLAG_PENDING | FLAG_EXITED) == 0);
+    assert(handle_table_clear_flags(&table, handle, FLAG_EXITED) == 0);
+    uint32_t flags = 0;
+    assert(handle_table_get_flags(&table, handle, &flags) == 0);
+    assert(flags == FLAG_PENDING);
+
+    assert(handle_table_release(&table, handle) == 0);
+    assert(!handle_table_is_valid(&table, handle));
+    assert(handle_table_get(&table, handle) == NULL);
+    assert(handle_table_find(&table, &context) == HANDLE_INVALID);
+    assert(handle_table_set_flags(&table, handle, FLAG_EXITED) == -1);
+    assert(handle_table_clear_flags(&table, handle, FLAG_PENDING) == -1);
+    assert(handle_table_get_flags(&table, handle, &flags) == -1);
+    assert(handle_table_release(&table, handle) == -1);
+
+    // The same slot and the same address come back with a new generation
+    handle_t reused = handle_table_insert(&table, &context);
+    assert(reused != HANDLE_INVALID && reused != handle);
+    assert(handle_table_handle_at(&table, 0) == reused);
+    assert(!handle_table_is_valid(&table, handle));
+    assert(handle_table_get(&table, handle) == NULL);
+    assert(handle_table_release(&table, handle) == -1);
+    assert(handle_table_set_flags(&table, handle, FLAG_EXITED) == -1);
+
+    // The new handle starts without the old flags, and the stale one did not touch it
+    assert(handle_table_get_flags(&table, reused, &flags) == 0);
+    assert(flags == 0);
+    assert(handle_table_get(&table, reused) == &context);
+    assert(handle_table_release(&table, reused) == 0);
+
+    printf("Stale handle test passed\n");
+}
+
+// Invalid and out-of-range handles are rejected, and a full table says so
+static void test_bounds(void) {
+    memset(&table, 0, sizeof(table));
+    int contexts[HANDLE_TABLE_SLOTS + 1];
+
+    assert(!handle_table_is_valid(&table, HANDLE_INVALID));
+    assert(handle_table_get(&table, HANDLE_INVALID) == NULL);
+    assert(handle_table_release(&table, HANDLE_INVALID) == -1);
+    assert(handle_table_handle_at(&table, -1) == HANDLE_INVALID);
+    assert(handle_table_handle_at(&table, HANDLE_TABLE_SLOTS) == HANDLE_INVALID);
+
+    handle_t handles[HANDLE_TABLE_SLOTS];
+    for (int i = 0; i < HANDLE_TABLE_SLOTS; i++) {
+        handles[i] = handle_table_insert(&table, &contexts[i]);
+        assert(handles[i] != HANDLE_INVALID);
+    }
+    assert(handle_table_insert(&table, &contexts[HANDLE_TABLE_SLOTS]) == HANDLE_INVALID);
+
+    // A handle pointing past the table is rejected, whatever its generation
+    handle_t outside = (handles[0] & 0xFFFFFFFF00000000ull) | HANDLE_TABLE_SLOTS;
+    assert(!handle_table_is_valid(&table, outside));
+    assert(handle_table_release(&table, outside) == -1);
+
+    for (int i = 0; i < HANDLE_TABLE_SLOTS; i++) {
+        assert(handle_table_get(&table, handles[i]) == &contexts[i]);
+        assert(handle_table_release(&table, handles[i]) == 0);
+    }
+    for (int i = 0; i < HANDLE_TABLE_SLOTS; i++) {
+        assert(handle_table_handle_at(&table, i) == HANDLE_INVALID);
+    }
+
+    printf("Bounds test passed\n");
+}
+
+static void *stress_thread(void *arg) {
+    int *context = arg;
+    for (int i = 0; i < STRESS_ROUNDS; i++) {
+        handle_t handle = handle_table_insert(&table, context);
+        assert(handle != HANDLE_INVALID);
+        assert(handle_table_get(&table, handle) == context);
+        assert(handle_table_set_flags(&table, handle, FLAG_EXITED) == 0);
+        assert(handle_table_release(&table, handle) == 0);
+        assert(handle_table_get(&table, handle) == NULL);
+        assert(handle_table_release(&table, handle) == -1);
+    }
+    return NULL;
+}
+
+// Threads racing for the same slots never see each other's pointers
+static void test_concurrent(void) {
+    memset(&table, 0, sizeof(table));
+    pthread_t threads[STRESS_THREADS];
+    int contexts[STRESS_THREADS];
+
+    for (int i = 0; i < STRESS_THREADS; i++) {
+        assert(pthread_create(&threads[i], NULL, stress_thread, &contexts[i]) == 0);
+    }
+    for (int i = 0; i < STRESS_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    for (int i = 0; i < HANDLE_TABLE_SLOTS; i++) {
+        assert(handle_table_handle_at(&table, i) == HANDLE_INVALID);
+    }
+
+    printf("Concurrent test passed\n");
+}
+
+int main(void) {
+    printf("=== Handle Table Test ===\n");
+    test_stale_handle();
+    test_bounds();
+    test_concurrent();
+
+    printf("All tests passed!\n");
+    return 0;
+}
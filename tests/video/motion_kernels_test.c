@@ -0,0 +1,219 @@
+// The checks must also run in release builds
+#undef NDEBUG
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include "video/motion_kernels.h"
+
+#define MAX_VARIANTS 8
+
+// Largest test image; widths and heights below it cover every tail length
+#define MAX_WIDTH 83
+#define MAX_HEIGHT 11
+#define MAX_PIXELS (MAX_WIDTH * MAX_HEIGHT)
+
+// Buffers start one byte past an aligned address, so no vector load is aligned
+#define MISALIGN 1
+
+static const char *variants[MAX_VARIANTS];
+static int variant_count;
+static int mismatches;
+
+static uint32_t random_state = 12345;
+
+static uint8_t random_byte(void) {
+    random_state = random_state * 1664525u + 1013904223u;
+    return (uint8_t)(random_state >> 24);
+}
+
+static void fill_random(uint8_t *buf, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        buf[i] = random_byte();
+    }
+}
+
+// Compare the output of a variant with the scalar one
+static void check(const char *isa, const char *kernel, const char *params,
+                  const uint8_t *expected, const uint8_t *actual, size_t size) {
+    if (memcmp(expected, actual, size) != 0) {
+        printf("Mismatch: %s %s (%s)\n", isa, kernel, params);
+        mismatches++;
+    }
+}
+
+static void test_gray(uint8_t *rgb, uint8_t *expected, uint8_t *actual) {
+    for (int pixels = 1; pixels <= MAX_PIXELS; pixels += (pixels < 96 ? 1 : 37)) {
+        fill_random(rgb, (size_t)pixels * 3);
+        assert(motion_kernels_use("scalar") == 0);
+        memset(expected, 0xAA, (size_t)pixels + 16);
+        motion_rgb_to_gray(rgb, expected, pixels);
+        for (int v = 0; v < variant_count; v++) {
+            char params[32];
+            snprintf(params, sizeof(params), "%d pixels", pixels);
+            assert(motion_kernels_use(variants[v]) == 0);
+            memset(actual, 0xAA, (size_t)pixels + 16);
+            motion_rgb_to_gray(rgb, actual, pixels);
+            check(variants[v], "rgb_to_gray", params, expected, actual, (size_t)pixels + 16);
+        }
+    }
+}
+
+static void test_downscale(uint8_t *src, uint8_t *expected, uint8_t *actual) {
+    for (int factor = 2; factor <= 5; factor++) {
+        for (int width = 1; width <= MAX_WIDTH; width += 2) {
+            for (int height = 1; height <= MAX_HEIGHT; height += 3) {
+                int stride = width + 5;
+                int out_width = (width + factor - 1) / factor;
+                int out_height = (height + factor - 1) / factor;
+                size_t out_size = (size_t)out_width * out_height;
+                fill_random(src, (size_t)stride * height);
+
+                assert(motion_kernels_use("scalar") == 0);
+                memset(expected, 0xAA, out_size + 16);
+                motion_downscale_gray(src, stride, width, height, factor, expected, out_width, out_height);
+                for (int v = 0; v < variant_count; v++) {
+                    char params[64];
+                    snprintf(params, sizeof(params), "%dx%d, factor %d", width, height, factor);
+                    assert(motion_kernels_use(variants[v]) == 0);
+                    memset(actual, 0xAA, out_size + 16);
+                    motion_downscale_gray(src, stride, width, height, factor, actual, out_width, out_height);
+                    check(variants[v], "downscale_gray", params, expected, actual, out_size + 16);
+                }
+            }
+        }
+    }
+}
+
+static void test_blur(uint8_t *src, uint8_t *expected, uint8_t *actual, uint16_t *sums) {
+    // Radii past the vector limit take the scalar path in every variant
+    for (int radius = 1; radius <= 9; radius++) {
+        for (int width = 1; width <= MAX_WIDTH; width += 2) {
+            for (int height = 1; height <= MAX_HEIGHT; height += 2) {
+                size_t size = (size_t)width * height;
+                fill_random(src, size);
+                for (int pass = 0; pass < 2; pass++) {
+                    assert(motion_kernels_use("scalar") == 0);
+                    memset(expected, 0xAA, size + 16);
+                    if (pass == 0) {
+                        motion_box_blur_rows(src, expected, sums, width, height, radius);
+                    } else {
+                        motion_box_blur_cols(src, expected, sums, width, height, radius);
+                    }
+                    for (int v = 0; v < variant_count; v++) {
+                        char params[64];
+                        snprintf(params, sizeof(params), "%dx%d, radius %d", width, height, radius);
+                        assert(motion_kernels_use(variants[v]) == 0);
+                        memset(actual, 0xAA, size + 16);
+                        if (pass == 0) {
+                            motion_box_blur_rows(src, actual, sums, width, height, radius);
+                        } else {
+                            motion_box_blur_cols(src, actual, sums, width, height, radius);
+                        }
+                        check(variants[v], pass == 0 ? "box_blur_rows" : "box_blur_cols", params,
+                              expected, actual, size + 16);
+                    }
+                }
+            }
+        }
+    }
+}
+
+static void test_diff(uint8_t *cur, uint8_t *prev, uint8_t *bg) {
+    static const int thresholds[] = { -1, 0, 1, 25, 127, 128, 200, 254, 255 };
+    for (int count = 1; count <= MAX_PIXELS; count += (count < 96 ? 1 : 41)) {
+        fill_random(cur, (size_t)count);
+        fill_random(prev, (size_t)count);
+        fill_random(bg, (size_t)count);
+        for (size_t t = 0; t < sizeof(thresholds) / sizeof(thresholds[0]); t++) {
+            for (int step = 1; step <= 2; step++) {
+                // Start from non-zero totals, which the kernels must add to
+                uint32_t expected[2] = { 7, 3 };
+                assert(motion_kernels_use("scalar") == 0);
+                motion_diff_sum(cur, prev, bg, count, step, thresholds[t], &expected[0], &expected[1]);
+                for (int v = 0; v < variant_count; v++) {
+                    char params[64];
+                    snprintf(params, sizeof(params), "%d pixels, step %d, threshold %d",
+                             count, step, thresholds[t]);
+                    uint32_t actual[2] = { 7, 3 };
+                    assert(motion_kernels_use(variants[v]) == 0);
+                    motion_diff_sum(cur, prev, bg, count, step, thresholds[t], &actual[0], &actual[1]);
+                    check(variants[v], "diff_sum", params, (const uint8_t *)expected,
+                          (const uint8_t *)actual, sizeof(expected));
+                }
+            }
+        }
+    }
+}
+
+static void test_blend(uint8_t *background, uint8_t *current, uint8_t *expected, uint8_t *actual) {
+    static const int alphas[] = { 0, 1, 13, 128, 255, 256 };
+    for (int pixels = 1; pixels <= MAX_PIXELS; pixels += (pixels < 96 ? 1 : 43)) {
+        fill_random(background, (size_t)pixels);
+        fill_random(current, (size_t)pixels);
+        for (size_t a = 0; a < sizeof(alphas) / sizeof(alphas[0]); a++) {
+            assert(motion_kernels_use("scalar") == 0);
+            memcpy(expected, background, (size_t)pixels);
+            memset(expected + pixels, 0xAA, 16);
+            motion_blend_background(expected, current, pixels, alphas[a]);
+            for (int v = 0; v < variant_count; v++) {
+                char params[64];
+                snprintf(params, sizeof(params), "%d pixels, alpha %d", pixels, alphas[a]);
+                assert(motion_kernels_use(variants[v]) == 0);
+                memcpy(actual, background, (size_t)pixels);
+                memset(actual + pixels, 0xAA, 16);
+                motion_blend_background(actual, current, pixels, alphas[a]);
+                check(variants[v], "blend_background", params, expected, actual, (size_t)pixels + 16);
+            }
+        }
+    }
+}
+
+int main(void) {
+    printf("=== Motion Kernels Test ===\n");
+
+    variant_count = motion_kernels_variants(variants, MAX_VARIANTS);
+    assert(variant_count >= 1);
+    assert(strcmp(variants[variant_count - 1], "scalar") == 0);
+    assert(motion_kernels_use("no-such-isa") == -1);
+    for (int v = 0; v < variant_count; v++) {
+        printf("Testing %s against scalar\n", variants[v]);
+    }
+
+    // Room for the largest input (RGB or strided) plus the guard bytes
+    size_t size = (size_t)(MAX_WIDTH + 5) * MAX_HEIGHT * 3 + 64;
+    uint8_t *buffers[6];
+    for (int i = 0; i < 6; i++) {
+        buffers[i] = malloc(size + MISALIGN);
+        assert(buffers[i]);
+    }
+    uint8_t *a = buffers[0] + MISALIGN;
+    uint8_t *b = buffers[1] + MISALIGN;
+    uint8_t *c = buffers[2] + MISALIGN;
+    uint8_t *expected = buffers[3] + MISALIGN;
+    uint8_t *actual = buffers[4] + MISALIGN;
+    uint16_t *sums = (uint16_t *)buffers[5];
+
+    test_gray(a, expected, actual);
+    test_downscale(a, expected, actual);
+    test_blur(a, expected, actual, sums);
+    test_diff(a, b, c);
+    test_blend(a, b, expected, actual);
+
+    assert(motion_kernels_use(NULL) == 0);
+    assert(strcmp(motion_kernels_isa(), variants[0]) == 0);
+
+    for (int i = 0; i < 6; i++) {
+        free(buffers[i]);
+    }
+
+    if (mismatches > 0) {
+        printf("%d mismatches\n", mismatches);
+        return 1;
+    }
+    printf("All tests passed!\n");
+    return 0;
+}
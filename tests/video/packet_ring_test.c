@@ -0,0 +1,198 @@
+// The checks must also run in release builds
+#undef NDEBUG
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <assert.h>
+
+#include <libavcodec/avcodec.h>
+
+#include "video/packet_ring.h"
+#include "core/logger.h"
+
+// Depth 5 rounds up to 8 entries, with the high watermark at 6
+#define TEST_DEPTH 5
+#define TEST_CAPACITY 8
+#define TEST_WATERMARK 6
+
+static AVPacket *make_packet(int64_t pts, bool keyframe) {
+    AVPacket *pkt = av_packet_alloc();
+    assert(pkt);
+    assert(av_new_packet(pkt, 16) == 0);
+    memset(pkt->data, (int)(pts & 0xff), 16);
+    pkt->pts = pts;
+    pkt->dts = pts;
+    pkt->flags = keyframe ? AV_PKT_FLAG_KEY : 0;
+    return pkt;
+}
+
+// Push a video packet and return the ring's verdict
+static int push(packet_ring_t *ring, int64_t pts, bool keyframe) {
+    AVPacket *pkt = make_packet(pts, keyframe);
+    int rc = packet_ring_push(ring, pkt, true, (void *)(intptr_t)(pts + 1), NULL);
+    av_packet_free(&pkt);
+    return rc;
+}
+
+// Pop a packet and check that it is the expected one
+static void pop_expect(packet_ring_t *ring, int64_t pts) {
+    AVPacket *pkt = av_packet_alloc();
+    void *opaque = NULL;
+    assert(pkt);
+    assert(packet_ring_pop(ring, pkt, &opaque, NULL) == 0);
+    assert(pkt->pts == pts);
+    assert(pkt->size == 16 && pkt->data[15] == (uint8_t)(pts & 0xff));
+    assert(opaque == (void *)(intptr_t)(pts + 1));
+    av_packet_free(&pkt);
+}
+
+// An empty ring has nothing to read and does not wait once closed
+static void test_empty(void) {
+    packet_ring_t ring;
+    assert(packet_ring_init(&ring, TEST_DEPTH, NULL) == 0);
+
+    packet_ring_stats_t stats;
+    packet_ring_get_stats(&ring, &stats);
+    assert(stats.capacity == TEST_CAPACITY);
+    assert(stats.used == 0);
+
+    assert(packet_ring_count(&ring) == 0);
+    assert(packet_ring_peek(&ring) == NULL);
+    assert(packet_ring_pop(&ring, NULL, NULL, NULL) == -1);
+    assert(!packet_ring_wait(&ring, 0));
+    assert(!packet_ring_wait(&ring, 10));
+
+    packet_ring_close(&ring);
+    assert(packet_ring_is_closed(&ring));
+    assert(!packet_ring_wait(&ring, 1000));
+
+    packet_ring_destroy(&ring, NULL);
+    printf("Empty ring test passed\n");
+}
+
+// Above the watermark non-key frames are shed until the next key frame;
+// a full ring drops the whole GOP, key frame included
+static void test_full(void) {
+    packet_ring_t ring;
+    assert(packet_ring_init(&ring, TEST_DEPTH, NULL) == 0);
+
+    int64_t pts = 0;
+    assert(push(&ring, pts++, true) == 0);
+    for (int i = 1; i < TEST_WATERMARK; i++) {
+        assert(push(&ring, pts++, false) == 0);
+    }
+    assert(packet_ring_count(&ring) == TEST_WATERMARK);
+
+    // At the watermark: the rest of the GOP is dropped
+    assert(push(&ring, pts++, false) == 1);
+    assert(push(&ring, pts++, false) == 1);
+
+    // Key frames are still admitted until the ring is full
+    int64_t second_gop = pts;
+    assert(push(&ring, pts++, true) == 0);
+    int64_t third_gop = pts;
+    assert(push(&ring, pts++, true) == 0);
+    assert(packet_ring_count(&ring) == TEST_CAPACITY);
+    assert(packet_ring_wait(&ring, 0));
+
+    // Full: the key frame and the rest of its GOP are dropped
+    assert(push(&ring, pts++, true) == 1);
+    assert(push(&ring, pts++, false) == 1);
+    assert(packet_ring_count(&ring) == TEST_CAPACITY);
+
+    packet_ring_stats_t stats;
+    packet_ring_get_stats(&ring, &stats);
+    assert(stats.packets_pushed == TEST_CAPACITY);
+    assert(stats.packets_dropped == 4);
+    assert(stats.gops_dropped == 1);
+    assert(stats.overruns == 2);
+    assert(stats.used == TEST_CAPACITY);
+
+    // Packets come out in order, the dropped ones left out
+    for (int64_t i = 0; i < TEST_WATERMARK; i++) {
+        pop_expect(&ring, i);
+    }
+    pop_expect(&ring, second_gop);
+    pop_expect(&ring, third_gop);
+    assert(packet_ring_count(&ring) == 0);
+    assert(packet_ring_pop(&ring, NULL, NULL, NULL) == -1);
+
+    // Still skipping the dropped GOP: delivery resumes on a key frame
+    assert(push(&ring, pts++, false) == 1);
+    int64_t resumed = pts;
+    assert(push(&ring, pts++, true) == 0);
+    assert(push(&ring, pts++, false) == 0);
+    pop_expect(&ring, resumed);
+    pop_expect(&ring, resumed + 1);
+
+    packet_ring_destroy(&ring, NULL);
+    printf("Full ring test passed\n");
+}
+
+// Runs of pushes and pops cross the end of the entries many times, and the
+// indices cross UINT_MAX
+static void test_wrap(void) {
+    packet_ring_t ring;
+    assert(packet_ring_init(&ring, TEST_DEPTH, NULL) == 0);
+
+    // Only the difference of the indices matters, so start near overflow
+    atomic_store(&ring.head, UINT_MAX - 10);
+    atomic_store(&ring.tail, UINT_MAX - 10);
+
+    int64_t next_push = 0;
+    int64_t next_pop = 0;
+    for (int round = 0; round < 100; round++) {
+        int burst = 1 + round % TEST_WATERMARK;
+        for (int i = 0; i < burst; i++) {
+            assert(push(&ring, next_push++, true) == 0);
+        }
+        assert(packet_ring_count(&ring) == burst);
+        for (int i = 0; i < burst; i++) {
+            pop_expect(&ring, next_pop++);
+        }
+        assert(packet_ring_count(&ring) == 0);
+    }
+
+    packet_ring_stats_t stats;
+    packet_ring_get_stats(&ring, &stats);
+    assert(stats.packets_pushed == (uint64_t)next_push);
+    assert(stats.packets_dropped == 0);
+
+    packet_ring_destroy(&ring, NULL);
+    printf("Wrap-around test passed\n");
+}
+
+static int released = 0;
+
+static void release_opaque(void *opaque) {
+    (void)opaque;
+    released++;
+}
+
+// Destroying a ring releases what is still queued
+static void test_destroy(void) {
+    packet_ring_t ring;
+    assert(packet_ring_init(&ring, TEST_DEPTH, NULL) == 0);
+    for (int i = 0; i < 3; i++) {
+        assert(push(&ring, i, true) == 0);
+    }
+    packet_ring_destroy(&ring, release_opaque);
+    assert(released == 3);
+    printf("Destroy test passed\n");
+}
+
+int main(void) {
+    init_logger();
+    set_log_level(LOG_LEVEL_ERROR);
+
+    printf("=== Packet Ring Test ===\n");
+    test_empty();
+    test_full();
+    test_wrap();
+    test_destroy();
+
+    printf("All tests passed!\n");
+    return 0;
+}
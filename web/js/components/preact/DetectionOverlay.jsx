@@ -5,6 +5,7 @@
 import { h } from 'preact';
 import { useState, useEffect, useRef, useCallback } from 'preact/hooks';
 import { showStatusMessage } from './ToastContainer.jsx';
+import { WebSocketClient } from '../../websocket-client.js';
 
 import { forwardRef, useImperativeHandle } from 'preact/compat';
 
@@ -29,6 +30,7 @@ export const DetectionOverlay = forwardRef(({
   const intervalRef = useRef(null);
   const errorCountRef = useRef(0);
   const currentIntervalRef = useRef(1000); // Start with 1 second polling interval
+  const wsClientRef = useRef(null);
 
   // Expose the canvas ref to parent components
   useImperativeHandle(ref, () => ({
@@ -118,6 +120,11 @@ export const DetectionOverlay = forwardRef(({
       return;
     }
 
+    // Results are pushed while the WebSocket is up; polling is the fallback
+    if (wsClientRef.current && wsClientRef.current.isConnected()) {
+      return;
+    }
+
     // Fetch detection results from API
     fetch(`/api/detection/results/${encodeURIComponent(streamName)}`)
       .then(response => {
@@ -184,6 +191,36 @@ export const DetectionOverlay = forwardRef(({
     }
   }, [enabled, detectionModel, streamName, pollDetections, videoRef]);
 
+  // Subscribe to the detections pushed for this stream
+  useEffect(() => {
+    if (!enabled || !detectionModel || !streamName) {
+      return;
+    }
+
+    if (!window.wsClient) {
+      window.wsClient = new WebSocketClient();
+    }
+    wsClientRef.current = window.wsClient;
+
+    // Each detection is [label, confidence, x, y, width, height, track_id]
+    const topic = `detections/${streamName}`;
+    const handleDetections = (payload) => {
+      if (!payload || !Array.isArray(payload.d)) {
+        return;
+      }
+      setDetections(payload.d.map(([label, confidence, x, y, width, height, track_id]) => ({
+        label, confidence, x, y, width, height, track_id
+      })));
+    };
+
+    wsClientRef.current.on('detections', topic, handleDetections);
+
+    return () => {
+      wsClientRef.current.off('detections', topic, handleDetections);
+      setDetections([]);
+    };
+  }, [enabled, detectionModel, streamName]);
+
   // Draw detections whenever they change
   useEffect(() => {
     drawDetectionBoxes();
@@ -9,6 +9,7 @@ import { DetectionOverlay, takeSnapshotWithDetections } from './DetectionOverlay
 import { SnapshotButton } from './SnapshotManager.jsx';
 import { LoadingIndicator } from './LoadingIndicator.jsx';
 import { showSnapshotPreview } from './UI.jsx';
+import { useTileVisibility, TileSnapshot } from './TileSnapshot.jsx';
 import Hls from 'hls.js';
 
 /**
@@ -36,17 +37,29 @@ export function HLSVideoCell({
   const detectionOverlayRef = useRef(null);
   const refreshTimerRef = useRef(null);
 
+  // Only tiles on screen in a visible tab have a player
+  const visible = useTileVisibility(cellRef);
+
   // Initialize HLS player when component mounts
   useEffect(() => {
     if (!stream || !stream.name || !videoRef.current) return;
 
+    // Hidden tiles show a snapshot instead
+    if (!visible) {
+      setIsLoading(false);
+      setIsPlaying(false);
+      setError(null);
+      return;
+    }
+
     console.log(`Initializing HLS player for stream ${stream.name}`);
     setIsLoading(true);
     setError(null);
 
     // Build the HLS stream URL with cache-busting timestamp to prevent stale data
+    // The master playlist also lists the transcoded renditions (hls_abr_renditions)
     const timestamp = Date.now();
-    const hlsStreamUrl = `/hls/${encodeURIComponent(stream.name)}/index.m3u8?_t=${timestamp}`;
+    const hlsStreamUrl = `/hls/${encodeURIComponent(stream.name)}/master.m3u8?_t=${timestamp}`;
 
     // Check if HLS.js is supported
     if (Hls.isSupported()) {
@@ -57,13 +70,17 @@ export function HLSVideoCell({
         liveSyncDurationCount: 4,       // Increased from 3 to 4 segments for better stability
         liveMaxLatencyDurationCount: 10, // Increased from 5 to 10 segments for better stability on low-power devices
         liveDurationInfinity: false,    // Don't treat live streams as infinite duration
-        lowLatencyMode: false,          // Disable low latency mode for better stability on low-power devices
+        lowLatencyMode: true,           // Only used when the server publishes parts (hls_low_latency)
         enableWorker: true,
         fragLoadingTimeOut: 30000,      // Increased from 20 to 30 seconds timeout for fragment loading
         manifestLoadingTimeOut: 20000,  // Increased from 15 to 20 seconds timeout for manifest loading
+        manifestLoadingMaxRetry: 8,     // On-demand streams answer 503 for a few seconds while they start
+        manifestLoadingRetryDelay: 1000,
         levelLoadingTimeOut: 20000,     // Increased from 15 to 20 seconds timeout for level loading
+        levelLoadingMaxRetry: 8,        // Renditions answer 503 while their transcoding starts
+        levelLoadingRetryDelay: 1000,
         backBufferLength: 60,           // Add back buffer length to keep more segments in memory
-        startLevel: -1,                 // Auto-select quality level based on network conditions
+        startLevel: 0,                  // Start with the stream itself; renditions are transcoded only once switched to
         abrEwmaDefaultEstimate: 500000, // Start with a lower bandwidth estimate (500kbps)
         abrBandWidthFactor: 0.7,        // Be more conservative with bandwidth estimates
         abrBandWidthUpFactor: 0.5       // Be more conservative when increasing quality
@@ -98,7 +115,7 @@ export function HLSVideoCell({
         if (hls) {
           console.log(`Refreshing HLS stream for ${stream.name}`);
           const newTimestamp = Date.now();
-          const newUrl = `/hls/${encodeURIComponent(stream.name)}/index.m3u8?_t=${newTimestamp}`;
+          const newUrl = `/hls/${encodeURIComponent(stream.name)}/master.m3u8?_t=${newTimestamp}`;
           hls.loadSource(newUrl);
         }
       }, refreshInterval);
@@ -152,7 +169,7 @@ export function HLSVideoCell({
         videoRef.current.load();
       }
     };
-  }, [stream]);
+  }, [stream, visible]);
 
   // Handle retry button click
   const handleRetry = () => {
@@ -210,8 +227,11 @@ export function HLSVideoCell({
         style={{ width: '100%', height: '100%', objectFit: 'contain' }}
       />
 
+      {/* Snapshot while there is no playing video */}
+      <TileSnapshot streamName={stream.name} active={!isPlaying} />
+
       {/* Detection overlay component */}
-      {stream.detection_based_recording && stream.detection_model && (
+      {visible && stream.detection_based_recording && stream.detection_model && (
         <DetectionOverlay
           ref={detectionOverlayRef}
           streamName={stream.name}
@@ -416,7 +436,7 @@ export function HLSVideoCell({
       )}
 
       {/* Play button overlay (for browsers that block autoplay) */}
-      {!isPlaying && !isLoading && !error && (
+      {visible && !isPlaying && !isLoading && !error && (
         <div
           className="play-overlay"
           style={{
@@ -0,0 +1,166 @@
+/**
+ * LightNVR Web Interface MotionMaskEditor Component
+ * Grid over a snapshot of the stream on which the cells motion detection
+ * ignores are clicked on or off
+ */
+
+import { useState } from 'react';
+
+// Grid sizes offered; the motion detector accepts 2-32
+const GRID_SIZES = [6, 8, 12, 16];
+const DEFAULT_GRID_SIZE = 8;
+
+/**
+ * Parse the text form of a motion mask ("N:" and one group of N/4 hex
+ * digits per row, the high bit of a row's first digit being its left cell)
+ * @param {string} text - Mask text, empty for none
+ * @returns {{gridSize: number, cells: boolean[]}} Grid size and masked cells, row by row
+ */
+export function parseMotionMask(text) {
+  const match = /^\s*(\d+):([0-9a-fA-F]*)\s*$/.exec(text || '');
+  const gridSize = match ? parseInt(match[1], 10) : 0;
+  const digits = Math.ceil(gridSize / 4);
+  if (!match || gridSize < 2 || gridSize > 32 || match[2].length !== gridSize * digits) {
+    return { gridSize: DEFAULT_GRID_SIZE, cells: new Array(DEFAULT_GRID_SIZE * DEFAULT_GRID_SIZE).fill(false) };
+  }
+
+  const cells = [];
+  for (let y = 0; y < gridSize; y++) {
+    for (let x = 0; x < gridSize; x++) {
+      const value = parseInt(match[2][y * digits + Math.floor(x / 4)], 16);
+      cells.push((value & (8 >> (x % 4))) !== 0);
+    }
+  }
+  return { gridSize, cells };
+}
+
+/**
+ * Write a motion mask in its text form
+ * @param {number} gridSize - Grid size
+ * @param {boolean[]} cells - Masked cells, row by row
+ * @returns {string} Mask text, empty if no cell is masked
+ */
+export function formatMotionMask(gridSize, cells) {
+  if (!cells.some(Boolean)) {
+    return '';
+  }
+
+  const digits = Math.ceil(gridSize / 4);
+  let text = `${gridSize}:`;
+  for (let y = 0; y < gridSize; y++) {
+    for (let d = 0; d < digits; d++) {
+      let value = 0;
+      for (let bit = 0; bit < 4; bit++) {
+        const x = d * 4 + bit;
+        if (x < gridSize && cells[y * gridSize + x]) {
+          value |= 8 >> bit;
+        }
+      }
+      text += value.toString(16);
+    }
+  }
+  return text;
+}
+
+/**
+ * MotionMaskEditor component
+ * @param {Object} props - Component props
+ * @param {string} props.streamName - Stream whose snapshot is shown under the grid
+ * @param {string} props.value - Mask text
+ * @param {Function} props.onChange - Called with the new mask text
+ * @returns {JSX.Element} MotionMaskEditor component
+ */
+export function MotionMaskEditor({ streamName, value, onChange }) {
+  // An empty mask has no grid of its own, so the size picked for it is kept here
+  const [emptyGridSize, setEmptyGridSize] = useState(DEFAULT_GRID_SIZE);
+
+  // Dragging paints every cell passed over with the state the first one got
+  const [paintValue, setPaintValue] = useState(null);
+
+  const parsed = parseMotionMask(value);
+  const gridSize = value ? parsed.gridSize : emptyGridSize;
+  const cells = value ? parsed.cells : new Array(gridSize * gridSize).fill(false);
+
+  // Empty the mask, keeping a grid of the given size on screen
+  const clear = (size) => {
+    setEmptyGridSize(size);
+    onChange('');
+  };
+
+  const changeGridSize = (e) => {
+    // Cells of the old grid do not map onto the new one, so it starts empty
+    clear(parseInt(e.target.value, 10));
+  };
+
+  const paint = (index, start) => {
+    const masked = start ? !cells[index] : paintValue;
+    if (masked === null) {
+      return;
+    }
+    if (start) {
+      setPaintValue(masked);
+    }
+    if (cells[index] !== masked) {
+      const next = cells.slice();
+      next[index] = masked;
+      setEmptyGridSize(gridSize);
+      onChange(formatMotionMask(gridSize, next));
+    }
+  };
+
+  const snapshotUrl = `/api/streams/${encodeURIComponent(streamName)}/snapshot.jpg?width=640`;
+  const maskedCount = cells.filter(Boolean).length;
+
+  return (
+    <div className="motion-mask-editor">
+      <div className="flex items-center space-x-2 mb-2">
+        <label for="motion-mask-grid" className="text-sm">Grid</label>
+        <select
+            id="motion-mask-grid"
+            className="px-2 py-1 border border-gray-300 rounded-md dark:bg-gray-700 dark:border-gray-600 dark:text-white"
+            value={gridSize}
+            onChange={changeGridSize}
+        >
+          {GRID_SIZES.concat(GRID_SIZES.includes(gridSize) ? [] : [gridSize]).map(size => (
+            <option key={size} value={size}>{size} x {size}</option>
+          ))}
+        </select>
+        <button
+            type="button"
+            className="px-2 py-1 text-sm bg-gray-200 rounded hover:bg-gray-300 dark:bg-gray-700 dark:hover:bg-gray-600"
+            onClick={() => clear(gridSize)}
+        >
+          Clear
+        </button>
+        <span className="text-xs text-gray-500 dark:text-gray-400">
+          {maskedCount} of {gridSize * gridSize} cells ignored
+        </span>
+      </div>
+      <div
+          className="relative w-full select-none bg-gray-900"
+          style={{ aspectRatio: '16 / 9' }}
+          onMouseUp={() => setPaintValue(null)}
+          onMouseLeave={() => setPaintValue(null)}
+      >
+        <img src={snapshotUrl} alt="" className="absolute inset-0 w-full h-full object-fill" draggable={false} />
+        <div
+            className="absolute inset-0 grid"
+            style={{
+              gridTemplateColumns: `repeat(${gridSize}, 1fr)`,
+              gridTemplateRows: `repeat(${gridSize}, 1fr)`
+            }}
+        >
+          {cells.map((masked, index) => (
+            <div
+                key={index}
+                className="border border-white border-opacity-20 cursor-pointer"
+                style={{ backgroundColor: masked ? 'rgba(220, 38, 38, 0.45)' : 'transparent' }}
+                onMouseDown={(e) => { e.preventDefault(); paint(index, true); }}
+                onMouseEnter={() => paint(index, false)}
+            />
+          ))}
+        </div>
+      </div>
+    </div>
+  );
+}
@@ -13,13 +13,11 @@ import { ContentLoader } from './LoadingIndicator.jsx';
 import { FiltersSidebar } from './recordings/FiltersSidebar.jsx';
 import { ActiveFilters } from './recordings/ActiveFilters.jsx';
 import { RecordingsTable } from './recordings/RecordingsTable.jsx';
-import { PaginationControls } from './recordings/PaginationControls.jsx';
 
 // Import utilities
 import { formatUtils } from './recordings/formatUtils.js';
 import { recordingsAPI } from './recordings/recordingsAPI.js';
 import { urlUtils } from './recordings/urlUtils.js';
-import { useQueryClient, invalidateQueries } from '../../query-client.js';
 import { WebSocketClient, BatchDeleteRecordingsClient } from '../../websocket-client.js';
 
 /**
@@ -27,7 +25,6 @@ import { WebSocketClient, BatchDeleteRecordingsClient } from '../../websocket-cl
  * @returns {JSX.Element} RecordingsView component
  */
 export function RecordingsView() {
-  const [recordings, setRecordings] = useState([]);
   const [streams, setStreams] = useState([]);
   const [filtersVisible, setFiltersVisible] = useState(true);
   const [sortField, setSortField] = useState('start_time');
@@ -42,12 +39,7 @@ export function RecordingsView() {
     recordingType: 'all'
   });
   const [pagination, setPagination] = useState({
-    currentPage: 1,
-    pageSize: 20,
-    totalItems: 0,
-    totalPages: 1,
-    startItem: 0,
-    endItem: 0
+    pageSize: 50
   });
   const [hasActiveFilters, setHasActiveFilters] = useState(false);
   const [activeFiltersDisplay, setActiveFiltersDisplay] = useState([]);
@@ -75,9 +67,6 @@ export function RecordingsView() {
     }
   }, [modalContext]);
 
-  // Get query client for invalidating queries
-  const queryClient = useQueryClient();
-
   // Fetch streams using preact-query
   const {
     data: streamsData,
@@ -196,8 +185,7 @@ export function RecordingsView() {
       setFilters(urlFilters.filters);
       setPagination(prev => ({
         ...prev,
-        currentPage: urlFilters.page || 1,
-        pageSize: urlFilters.limit || 20
+        pageSize: urlFilters.limit || prev.pageSize
       }));
       setSortField(urlFilters.sort || 'start_time');
       setSortDirection(urlFilters.order || 'desc');
@@ -231,44 +219,38 @@ export function RecordingsView() {
     }));
   };
 
-  // Fetch recordings using preact-query
+  // Load recordings as the table is scrolled
   const {
-    data: recordingsData,
+    recordings: loadedRecordings,
+    total: totalRecordings,
+    hasMore,
     isLoading: isLoadingRecordings,
+    isLoadingMore,
     error: recordingsError,
-    refetch: refetchRecordings
-  } = recordingsAPI.hooks.useRecordings(filters, pagination, sortField, sortDirection);
-
-  // Update recordings state when data is loaded
+    loadMore,
+    reload: reloadRecordings,
+    removeRecordings
+  } = recordingsAPI.hooks.useRecordingsFeed(filters, sortField, sortDirection, pagination.pageSize);
+
+  // When filtering for detection events, all returned recordings have detections
+  const recordings = filters.recordingType === 'detection'
+    ? loadedRecordings.map(recording => ({ ...recording, has_detections: true }))
+    : loadedRecordings;
+  const hasData = recordings.length > 0;
+
+  // Batch deletes refresh the list through this when they finish
   useEffect(() => {
-    if (recordingsData) {
-      // Store recordings in the component state
-      const recordingsArray = recordingsData.recordings || [];
-
-      // When filtering for detection events, all returned recordings should have detections
-      if (filters.recordingType === 'detection') {
-        recordingsArray.forEach(recording => {
-          recording.has_detections = true;
-        });
-      }
-
-      // Set the recordings state
-      setRecordings(recordingsArray);
-      setHasData(recordingsArray.length > 0);
-
-      // Update pagination
-      if (recordingsData.pagination) {
-        updatePaginationFromResponse(recordingsData, pagination.currentPage);
-      }
-    }
-  }, [recordingsData, filters.recordingType]);
+    window.loadRecordings = reloadRecordings;
+    return () => {
+      delete window.loadRecordings;
+    };
+  }, []);
 
   // Handle recordings error
   useEffect(() => {
     if (recordingsError) {
       console.error('Error loading recordings:', recordingsError);
       showStatusMessage('Error loading recordings: ' + recordingsError.message);
-      setHasData(false);
     }
   }, [recordingsError]);
 
@@ -286,8 +268,7 @@ export function RecordingsView() {
       setFilters(urlFilters.filters);
       setPagination(prev => ({
         ...prev,
-        currentPage: urlFilters.page || 1,
-        pageSize: urlFilters.limit || 20
+        pageSize: urlFilters.limit || prev.pageSize
       }));
       setSortField(urlFilters.sort || 'start_time');
       setSortDirection(urlFilters.order || 'desc');
@@ -323,101 +304,6 @@ export function RecordingsView() {
     setFiltersVisible(!filtersVisible);
   };
 
-  // State for data status
-  const [hasData, setHasData] = useState(false);
-
-  // Load recordings (now just updates pagination and URL)
-  const loadRecordings = (page = pagination.currentPage, updateUrl = true) => {
-    // Debug log to check filters
-    console.log('Loading recordings with filters:', JSON.stringify(filters));
-
-    // Create a pagination object with the specified page
-    const paginationWithPage = {
-      ...pagination,
-      currentPage: page
-    };
-
-    // Update pagination state
-    setPagination(paginationWithPage);
-
-    // Update URL with filters if requested
-    if (updateUrl) {
-      urlUtils.updateUrlWithFilters(filters, paginationWithPage, sortField, sortDirection);
-    }
-  };
-
-  // Update pagination from API response
-  const updatePaginationFromResponse = (data, currentPage) => {
-    // Use the provided page parameter instead of the state
-    currentPage = currentPage || pagination.currentPage;
-
-    if (data.pagination) {
-      const pageSize = data.pagination.limit || 20;
-      const totalItems = data.pagination.total || 0;
-      const totalPages = data.pagination.pages || 1;
-
-      // Calculate start and end items based on current page
-      let startItem = 0;
-      let endItem = 0;
-
-      if (data.recordings.length > 0) {
-        startItem = (currentPage - 1) * pageSize + 1;
-        endItem = Math.min(startItem + data.recordings.length - 1, totalItems);
-      }
-
-      console.log('Pagination update:', {
-        currentPage,
-        pageSize,
-        totalItems,
-        totalPages,
-        startItem,
-        endItem,
-        recordingsLength: data.recordings.length
-      });
-
-      setPagination(prev => ({
-        ...prev,
-        totalItems,
-        totalPages,
-        pageSize,
-        startItem,
-        endItem
-      }));
-    } else {
-      // Fallback if pagination object is not provided
-      const pageSize = pagination.pageSize;
-      const totalItems = data.total || 0;
-      const totalPages = Math.ceil(totalItems / pageSize) || 1;
-
-      // Calculate start and end items based on current page
-      let startItem = 0;
-      let endItem = 0;
-
-      if (data.recordings.length > 0) {
-        startItem = (currentPage - 1) * pageSize + 1;
-        endItem = Math.min(startItem + data.recordings.length - 1, totalItems);
-      }
-
-      console.log('Pagination update (fallback):', {
-        currentPage,
-        pageSize,
-        totalItems,
-        totalPages,
-        startItem,
-        endItem,
-        recordingsLength: data.recordings.length
-      });
-
-      setPagination(prev => ({
-        ...prev,
-        totalItems,
-        totalPages,
-        startItem,
-        endItem
-      }));
-    }
-  };
-
   // Handle date range change
   const handleDateRangeChange = (e) => {
     const newDateRange = e.target.value;
@@ -450,23 +336,9 @@ export function RecordingsView() {
     setActiveFiltersDisplay(activeFilters);
   };
 
-  // Apply filters
-  const applyFilters = (resetToFirstPage = true) => {
-    // Reset to first page when applying filters (unless specified otherwise)
-    if (resetToFirstPage) {
-      setPagination(prev => ({
-        ...prev,
-        currentPage: 1
-      }));
-    }
-
-    // Update URL with filters
-    urlUtils.updateUrlWithFilters(
-      filters,
-      resetToFirstPage ? {...pagination, currentPage: 1} : pagination,
-      sortField,
-      sortDirection
-    );
+  // Apply filters; the list starts over at the top
+  const applyFilters = () => {
+    urlUtils.updateUrlWithFilters(filters, pagination, sortField, sortDirection);
   };
 
   // Reset filters
@@ -493,12 +365,6 @@ export function RecordingsView() {
     // Reset filter state
     setFilters(defaultFilters);
 
-    // Reset pagination to first page
-    setPagination(prev => ({
-      ...prev,
-      currentPage: 1
-    }));
-
     // Reset sort
     setSortField('start_time');
     setSortDirection('desc');
@@ -545,35 +411,15 @@ export function RecordingsView() {
       setSortField(field);
     }
 
-    // Reset to first page
-    setPagination(prev => ({
-      ...prev,
-      currentPage: 1
-    }));
-
     // Update URL with new sort parameters
     urlUtils.updateUrlWithFilters(
       filters,
-      {...pagination, currentPage: 1},
+      pagination,
       field,
       field === sortField ? (sortDirection === 'asc' ? 'desc' : 'asc') : (field === 'start_time' ? 'desc' : 'asc')
     );
   };
 
-  // Go to page
-  const goToPage = (page) => {
-    if (page < 1 || page > pagination.totalPages) return;
-
-    // Set the current page in pagination state
-    setPagination(prev => ({
-      ...prev,
-      currentPage: page
-    }));
-
-    // Update URL with all filters and the new page
-    urlUtils.updateUrlWithFilters(filters, {...pagination, currentPage: page}, sortField, sortDirection);
-  };
-
   // Toggle selection of a recording
   const toggleRecordingSelection = (recordingId) => {
     setSelectedRecordings(prev => ({
@@ -618,12 +464,6 @@ export function RecordingsView() {
   const handleDeleteConfirm = async () => {
     closeDeleteModal();
 
-    // Save current URL parameters before deletion
-    const currentUrlParams = new URLSearchParams(window.location.search);
-    const currentSortField = currentUrlParams.get('sort') || sortField;
-    const currentSortDirection = currentUrlParams.get('order') || sortDirection;
-    const currentPage = parseInt(currentUrlParams.get('page'), 10) || pagination.currentPage;
-
     if (deleteMode === 'selected') {
       // Use the recordingsAPI to delete selected recordings
       const result = await recordingsAPI.deleteSelectedRecordings(selectedRecordings);
@@ -632,10 +472,9 @@ export function RecordingsView() {
       setSelectedRecordings({});
       setSelectAll(false);
 
-      // Only reload if some recordings were deleted successfully
+      // Reload from the top if some recordings were deleted
       if (result.succeeded > 0) {
-        // Reload recordings with preserved parameters
-        reloadRecordingsWithPreservedParams(currentSortField, currentSortDirection, currentPage);
+        reloadRecordings();
       }
     } else {
       // Use the recordingsAPI to delete all filtered recordings
@@ -647,64 +486,20 @@ export function RecordingsView() {
 
       // Only reload if some recordings were deleted successfully
       if (result.succeeded > 0) {
-        // Reload recordings
-        loadRecordings();
+        reloadRecordings();
       }
     }
   };
 
-  // Helper function to reload recordings with preserved parameters
-  const reloadRecordingsWithPreservedParams = (sortField, sortDirection, page) => {
-    // Set the sort parameters directly
-    setSortField(sortField);
-    setSortDirection(sortDirection);
-
-    // Update pagination with the preserved page
-    setPagination(prev => ({
-      ...prev,
-      currentPage: page
-    }));
-
-    // Wait for state to update
-    setTimeout(() => {
-      // Create a new pagination object with the updated page
-      const updatedPagination = {
-        ...pagination,
-        currentPage: page
-      };
-
-      // Update URL with all filters and the preserved parameters
-      urlUtils.updateUrlWithFilters(filters, updatedPagination, sortField, sortDirection);
-
-      // Load recordings from API
-      recordingsAPI.loadRecordings(filters, updatedPagination, sortField, sortDirection)
-        .then(data => {
-          console.log('Recordings data received:', data);
-
-          // Store recordings in the component state
-          setRecordings(data.recordings || []);
-
-          // Update pagination without changing the current page
-          updatePaginationFromResponse(data, page);
-        })
-        .catch(error => {
-          console.error('Error loading recordings:', error);
-          showStatusMessage('Error loading recordings: ' + error.message);
-        });
-    }, 0);
-  };
-
-  // Delete recording using preact-query mutation
-  const { mutate: deleteRecordingMutation } = recordingsAPI.hooks.useDeleteRecording();
-
-  // Delete a single recording
-  const deleteRecording = (recording) => {
+  // Delete a single recording, keeping the scroll position
+  const deleteRecording = async (recording) => {
     if (!confirm(`Are you sure you want to delete this recording from ${recording.stream}?`)) {
       return;
     }
 
-    // Call the mutation with the recording ID
-    deleteRecordingMutation(recording.id);
+    if (await recordingsAPI.deleteRecording(recording)) {
+      removeRecordings([recording.id]);
+    }
   };
 
   // Play recording
@@ -794,12 +589,10 @@ export function RecordingsView() {
               downloadRecording={downloadRecording}
               deleteRecording={deleteRecording}
               recordingsTableBodyRef={recordingsTableBodyRef}
-              pagination={pagination}
-            />
-
-            <PaginationControls
-              pagination={pagination}
-              goToPage={goToPage}
+              totalItems={totalRecordings}
+              hasMore={hasMore}
+              isLoadingMore={isLoadingMore}
+              onEndReached={loadMore}
             />
           </ContentLoader>
         </div>
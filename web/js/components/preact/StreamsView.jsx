@@ -7,6 +7,7 @@ import { useState } from 'react';
 import { showStatusMessage } from './ToastContainer.jsx';
 import { ContentLoader } from './LoadingIndicator.jsx';
 import { StreamDeleteModal } from './StreamDeleteModal.jsx';
+import { MotionMaskEditor } from './MotionMaskEditor.jsx';
 import {
   useQuery,
   useMutation,
@@ -262,6 +263,7 @@ export function StreamsView() {
       detection_interval: parseInt(currentStream.detectionInterval, 10),
       pre_detection_buffer: parseInt(currentStream.preBuffer, 10),
       post_detection_buffer: parseInt(currentStream.postBuffer, 10),
+      motion_mask: currentStream.motionMask,
       record_audio: currentStream.recordAudio
     };
 
@@ -320,7 +322,8 @@ export function StreamsView() {
       detectionThreshold: 50,
       detectionInterval: 10,
       preBuffer: 10,
-      postBuffer: 30
+      postBuffer: 30,
+      motionMask: ''
     });
     setIsEditing(false);
     setModalVisible(true);
@@ -355,6 +358,7 @@ export function StreamsView() {
         detectionInterval: stream.detection_interval || 10,
         preBuffer: stream.pre_detection_buffer || 10,
         postBuffer: stream.post_detection_buffer || 30,
+        motionMask: stream.motion_mask || '',
         // Map API fields to form fields
         streamingEnabled: stream.streaming_enabled !== undefined ? stream.streaming_enabled : true,
         isOnvif: stream.is_onvif !== undefined ? stream.is_onvif : false,
@@ -1003,6 +1007,19 @@ export function StreamsView() {
                     <span className="text-xs text-gray-500 dark:text-gray-400">Seconds to keep after detection</span>
                   </div>
                 </div>
+                {isEditing && currentStream.detectionEnabled && (
+                  <div className="form-group">
+                    <label className="block text-sm font-medium mb-1">Motion Mask</label>
+                    <span className="block text-xs text-gray-500 dark:text-gray-400 mb-2">
+                      Click or drag over the parts of the picture motion detection should ignore, such as trees, a road or a timestamp
+                    </span>
+                    <MotionMaskEditor
+                        streamName={currentStream.name}
+                        value={currentStream.motionMask}
+                        onChange={(motionMask) => setCurrentStream(prev => ({ ...prev, motionMask }))}
+                    />
+                  </div>
+                )}
               </form>
             </div>
             <div className="flex justify-between p-4 border-t border-gray-200 dark:border-gray-700">
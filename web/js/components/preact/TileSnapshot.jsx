@@ -0,0 +1,160 @@
+/**
+ * Visibility of live view tiles, and the snapshots shown in place of their players
+ *
+ * A tile only streams while it is on screen in a visible tab. Tiles
+ * scrolled out of view, on another page of the grid or in a hidden tab
+ * drop their player, so the server can stop producing segments nobody
+ * watches, and show a still from the snapshot endpoint instead.
+ */
+
+import { h } from 'preact';
+import { useState, useEffect, useRef } from 'preact/hooks';
+
+// How long a tile stays attached after leaving the view, so quick scrolls
+// and tab switches do not reconnect
+const DETACH_DELAY_MS = 5000;
+
+// Tiles this close to the viewport count as visible, so they are playing
+// by the time they are scrolled in
+const VISIBILITY_MARGIN = '100px';
+
+// How often snapshots of tiles without a player are refreshed
+const SNAPSHOT_REFRESH_MS = 10000;
+
+// Size and quality of snapshots; they are only a placeholder
+const SNAPSHOT_WIDTH = 480;
+const SNAPSHOT_QUALITY = 60;
+
+/**
+ * Whether the page is visible
+ * @returns {boolean} false while the tab is hidden
+ */
+function isPageVisible() {
+  return typeof document === 'undefined' || document.visibilityState !== 'hidden';
+}
+
+/**
+ * Track whether a tile is on screen in a visible tab
+ * @param {Object} ref - Ref of the tile element
+ * @returns {boolean} Whether the tile should have a player
+ */
+export function useTileVisibility(ref) {
+  // With IntersectionObserver, tiles wait for its first report, so those
+  // out of view never connect
+  const observable = typeof IntersectionObserver !== 'undefined';
+  const [visible, setVisible] = useState(!observable && isPageVisible());
+  const inViewRef = useRef(!observable);
+  const timerRef = useRef(null);
+
+  useEffect(() => {
+    const update = () => {
+      const shouldPlay = inViewRef.current && isPageVisible();
+      if (timerRef.current) {
+        clearTimeout(timerRef.current);
+        timerRef.current = null;
+      }
+      if (shouldPlay) {
+        setVisible(true);
+      } else {
+        timerRef.current = setTimeout(() => {
+          timerRef.current = null;
+          setVisible(false);
+        }, DETACH_DELAY_MS);
+      }
+    };
+
+    // Without IntersectionObserver every tile counts as in view
+    let observer = null;
+    if (ref.current && observable) {
+      observer = new IntersectionObserver(entries => {
+        const entry = entries[entries.length - 1];
+        inViewRef.current = entry.isIntersecting;
+        update();
+      }, { rootMargin: VISIBILITY_MARGIN });
+      observer.observe(ref.current);
+    }
+
+    document.addEventListener('visibilitychange', update);
+    return () => {
+      document.removeEventListener('visibilitychange', update);
+      if (observer) {
+        observer.disconnect();
+      }
+      if (timerRef.current) {
+        clearTimeout(timerRef.current);
+      }
+    };
+  }, []);
+
+  return visible;
+}
+
+/**
+ * Still of a stream, shown while its tile has no playing player
+ * @param {Object} props - Component props
+ * @param {string} props.streamName - Name of the stream
+ * @param {boolean} props.active - Whether to show and refresh the snapshot
+ * @returns {JSX.Element|null} TileSnapshot component
+ */
+export function TileSnapshot({ streamName, active }) {
+  const [src, setSrc] = useState(null);
+
+  useEffect(() => {
+    if (!active) return;
+
+    let cancelled = false;
+    let retries = 0;
+    let retryTimer = null;
+    const base = `/api/streams/${encodeURIComponent(streamName)}/snapshot.jpg?width=${SNAPSHOT_WIDTH}&quality=${SNAPSHOT_QUALITY}`;
+
+    // Load the next snapshot aside and swap it in once it arrived, so a
+    // failed request keeps the last one
+    const refresh = () => {
+      if (!isPageVisible()) return;
+      const url = `${base}&_t=${Date.now()}`;
+      const image = new Image();
+      image.onload = () => {
+        retries = 0;
+        if (!cancelled) setSrc(url);
+      };
+      // The first request after a quiet period is answered with 503 while
+      // the server decodes a frame; try again a second later
+      image.onerror = () => {
+        if (!cancelled && retries < 3) {
+          retries++;
+          retryTimer = setTimeout(refresh, 1000);
+        }
+      };
+      image.src = url;
+    };
+
+    refresh();
+    const timer = setInterval(refresh, SNAPSHOT_REFRESH_MS);
+    return () => {
+      cancelled = true;
+      clearInterval(timer);
+      clearTimeout(retryTimer);
+    };
+  }, [streamName, active]);
+
+  if (!active || !src) return null;
+
+  return (
+    <img
+      className="tile-snapshot"
+      src={src}
+      alt={`Snapshot of ${streamName}`}
+      style={{
+        position: 'absolute',
+        top: 0,
+        left: 0,
+        width: '100%',
+        height: '100%',
+        objectFit: 'contain',
+        backgroundColor: 'black',
+        zIndex: 2,
+        pointerEvents: 'none'
+      }}
+    />
+  );
+}
@@ -6,6 +6,7 @@
 import { h, createContext } from 'preact';
 import { useState, useEffect, useRef, useCallback } from 'preact/hooks';
 import { createPortal } from 'preact/compat';
+import Hls from 'hls.js';
 import { showStatusMessage } from './ToastContainer.jsx';
 import { useSnapshotManager } from './SnapshotManager.jsx';
 
@@ -207,6 +208,39 @@ export function VideoModal({ isOpen, onClose, videoUrl, title, downloadUrl }) {
   const videoRef = useRef(null);
   const canvasRef = useRef(null);
   const modalRef = useRef(null);
+  const hlsRef = useRef(null);
+
+  // Browsers without HEVC support play the recording as H.264 transcoded by the server
+  const playTranscoded = useCallback(() => {
+    const recordingIdMatch = videoUrl && videoUrl.match(/\/play\/(\d+)/);
+    if (hlsRef.current || !recordingIdMatch || !videoRef.current || !Hls.isSupported()) {
+      return false;
+    }
+
+    console.log('Falling back to H.264 playback of recording', recordingIdMatch[1]);
+    const hls = new Hls({ fragLoadingMaxRetry: 8, fragLoadingRetryDelay: 2000 });
+    hlsRef.current = hls;
+    hls.on(Hls.Events.ERROR, (event, data) => {
+      if (data.fatal) {
+        console.error('Transcoded playback error:', data);
+        showStatusMessage('Error loading video. Please try again.', 'error');
+        hls.destroy();
+      }
+    });
+    hls.loadSource(`/api/recordings/vod/${recordingIdMatch[1]}/index.m3u8?codec=h264`);
+    hls.attachMedia(videoRef.current);
+    return true;
+  }, [videoUrl]);
+
+  // Drop the transcoded playback when the recording changes or the modal closes
+  useEffect(() => {
+    return () => {
+      if (hlsRef.current) {
+        hlsRef.current.destroy();
+        hlsRef.current = null;
+      }
+    };
+  }, [isOpen, videoUrl]);
 
   // Handle escape key and cleanup
   useEffect(() => {
@@ -523,13 +557,21 @@ export function VideoModal({ isOpen, onClose, videoUrl, title, downloadUrl }) {
               key={videoUrl} /* Add key to force re-render when URL changes */
               onError={(e) => {
                 console.error('Video error:', e);
-                showStatusMessage('Error loading video. Please try again.', 'error');
+                if (!playTranscoded()) {
+                  showStatusMessage('Error loading video. Please try again.', 'error');
+                }
               }}
               onLoadStart={() => console.log('Video load started')}
               onLoadedData={() => console.log('Video data loaded')}
             >
               {/* Use source element instead of src attribute for better control */}
-              {videoUrl && <source src={videoUrl} type="video/mp4" />}
+              {videoUrl && (
+                <source
+                  src={videoUrl}
+                  type="video/mp4"
+                  onError={() => playTranscoded()}
+                />
+              )}
             </video>
             <canvas
               ref={canvasRef}
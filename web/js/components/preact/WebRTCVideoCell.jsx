@@ -9,6 +9,7 @@ import { DetectionOverlay, takeSnapshotWithDetections } from './DetectionOverlay
 import { SnapshotButton } from './SnapshotManager.jsx';
 import { LoadingIndicator } from './LoadingIndicator.jsx';
 import { showSnapshotPreview } from './UI.jsx';
+import { useTileVisibility, TileSnapshot } from './TileSnapshot.jsx';
 import adapter from 'webrtc-adapter';
 
 /**
@@ -39,10 +40,21 @@ export function WebRTCVideoCell({
   const connectionMonitorRef = useRef(null);
   const reconnectAttemptsRef = useRef(0);
 
+  // Only tiles on screen in a visible tab have a player
+  const visible = useTileVisibility(cellRef);
+
   // Initialize WebRTC connection when component mounts
   useEffect(() => {
     if (!stream || !stream.name || !videoRef.current) return;
 
+    // Hidden tiles show a snapshot instead
+    if (!visible) {
+      setIsLoading(false);
+      setIsPlaying(false);
+      setError(null);
+      return;
+    }
+
     console.log(`Initializing WebRTC connection for stream ${stream.name}`);
     setIsLoading(true);
     setError(null);
@@ -290,7 +302,7 @@ export function WebRTCVideoCell({
         peerConnectionRef.current = null;
       }
     };
-  }, [stream]);
+  }, [stream, visible]);
 
   // Handle retry button click
   const handleRetry = () => {
@@ -338,8 +350,11 @@ export function WebRTCVideoCell({
         style={{ width: '100%', height: '100%', objectFit: 'contain' }}
       />
 
+      {/* Snapshot while there is no playing video */}
+      <TileSnapshot streamName={stream.name} active={!isPlaying} />
+
       {/* Detection overlay component */}
-      {stream.detection_based_recording && stream.detection_model && (
+      {visible && stream.detection_based_recording && stream.detection_model && (
         <DetectionOverlay
           ref={detectionOverlayRef}
           streamName={stream.name}
@@ -106,15 +106,15 @@ export function FiltersSidebar({
       <div className="filter-group mb-4">
         <h3 className="text-lg font-medium mb-2 pb-1 border-b border-gray-200 dark:border-gray-700">Display Options</h3>
         <div className="filter-option">
-          <label htmlFor="page-size" className="block mb-1 text-sm font-medium">Items per page:</label>
+          <label htmlFor="page-size" className="block mb-1 text-sm font-medium">Recordings loaded at a time:</label>
           <select id="page-size"
                   className="w-full p-2 border border-gray-300 rounded dark:bg-gray-700 dark:border-gray-600 dark:text-white"
                   value={pagination.pageSize}
                   onChange={e => setPagination(prev => ({ ...prev, pageSize: parseInt(e.target.value, 10) }))}>
-            <option value="10">10</option>
             <option value="20">20</option>
             <option value="50">50</option>
             <option value="100">100</option>
+            <option value="200">200</option>
           </select>
         </div>
       </div>
@@ -3,10 +3,26 @@
  */
 
 import { h } from 'preact';
+import { useState, useEffect, useRef } from 'preact/hooks';
 import { formatUtils } from './formatUtils.js';
 
+// Row height assumed until a row has been measured
+const DEFAULT_ROW_HEIGHT = 61;
+
+// Rows rendered above and below the visible ones
+const OVERSCAN_ROWS = 10;
+
+// Rows left below the visible ones when the next page is requested
+const LOAD_AHEAD_ROWS = 30;
+
 /**
  * RecordingsTable component
+ *
+ * Only the rows in view, and a few around them, are rendered; spacer rows
+ * stand in for the others, so the table stays light however many
+ * recordings have been loaded. onEndReached is called as the end of the
+ * loaded recordings comes near.
+ *
  * @param {Object} props Component props
  * @returns {JSX.Element} RecordingsTable component
  */
@@ -25,8 +41,73 @@ export function RecordingsTable({
   downloadRecording,
   deleteRecording,
   recordingsTableBodyRef,
-  pagination
+  totalItems,
+  hasMore,
+  isLoadingMore,
+  onEndReached
 }) {
+  const scrollRef = useRef(null);
+  const [scrollTop, setScrollTop] = useState(0);
+  const [viewportHeight, setViewportHeight] = useState(600);
+  const [rowHeight, setRowHeight] = useState(DEFAULT_ROW_HEIGHT);
+  const frameRef = useRef(0);
+
+  // Follow the height of the scroll area
+  useEffect(() => {
+    const element = scrollRef.current;
+    if (!element) return;
+
+    const measure = () => setViewportHeight(element.clientHeight || 600);
+    measure();
+    if (typeof ResizeObserver !== 'undefined') {
+      const observer = new ResizeObserver(measure);
+      observer.observe(element);
+      return () => observer.disconnect();
+    }
+    window.addEventListener('resize', measure);
+    return () => window.removeEventListener('resize', measure);
+  }, []);
+
+  // Back to the top when the list starts over
+  useEffect(() => {
+    if (recordings.length === 0 && scrollRef.current) {
+      scrollRef.current.scrollTop = 0;
+      setScrollTop(0);
+    }
+  }, [recordings.length === 0]);
+
+  // One update per frame, however many scroll events arrive
+  const handleScroll = () => {
+    if (frameRef.current) return;
+    frameRef.current = requestAnimationFrame(() => {
+      frameRef.current = 0;
+      if (scrollRef.current) {
+        setScrollTop(scrollRef.current.scrollTop);
+      }
+    });
+  };
+
+  useEffect(() => () => cancelAnimationFrame(frameRef.current), []);
+
+  const first = Math.max(0, Math.floor(scrollTop / rowHeight) - OVERSCAN_ROWS);
+  const last = Math.min(recordings.length, Math.ceil((scrollTop + viewportHeight) / rowHeight) + OVERSCAN_ROWS);
+  const visibleRecordings = recordings.slice(first, last);
+
+  // Measure the rendered rows once, their height does not change
+  const measureRow = (row) => {
+    if (row && rowHeight === DEFAULT_ROW_HEIGHT && row.offsetHeight > 0 && row.offsetHeight !== rowHeight) {
+      setRowHeight(row.offsetHeight);
+    }
+  };
+
+  // Ask for more before the end of the loaded rows comes into view; this
+  // also fills a tall screen when the first page does not
+  useEffect(() => {
+    if (hasMore && !isLoadingMore && last + LOAD_AHEAD_ROWS >= recordings.length) {
+      onEndReached();
+    }
+  }, [last, recordings.length, hasMore, isLoadingMore]);
+
   return (
     <div className="recordings-container bg-white dark:bg-gray-800 rounded-lg shadow overflow-hidden w-full">
       <div className="batch-actions p-3 border-b border-gray-200 dark:border-gray-700 flex flex-wrap gap-2 items-center">
@@ -47,9 +128,9 @@ export function RecordingsTable({
           Delete All Filtered
         </button>
       </div>
-      <div className="overflow-x-auto">
+      <div className="overflow-auto" style={{ maxHeight: '70vh' }} ref={scrollRef} onScroll={handleScroll}>
         <table id="recordings-table" className="min-w-full divide-y divide-gray-200 dark:divide-gray-700">
-          <thead className="bg-gray-50 dark:bg-gray-700">
+          <thead className="bg-gray-50 dark:bg-gray-700 sticky top-0 z-10">
             <tr>
               <th className="w-10 px-4 py-3">
                 <input
@@ -100,12 +181,16 @@ export function RecordingsTable({
           <tbody ref={recordingsTableBodyRef} className="bg-white divide-y divide-gray-200 dark:bg-gray-800 dark:divide-gray-700">
             {recordings.length === 0 ? (
               <tr>
-                <td colSpan="6" className="px-6 py-4 text-center text-gray-500 dark:text-gray-400">
-                  {pagination.totalItems === 0 ? 'No recordings found' : 'Loading recordings...'}
+                <td colSpan="7" className="px-6 py-4 text-center text-gray-500 dark:text-gray-400">
+                  {totalItems === 0 ? 'No recordings found' : 'Loading recordings...'}
                 </td>
               </tr>
-            ) : recordings.map(recording => (
-              <tr key={recording.id} className="hover:bg-gray-50 dark:hover:bg-gray-700">
+            ) : null}
+            {first > 0 && (
+              <tr aria-hidden="true" style={{ height: `${first * rowHeight}px` }}><td colSpan="7"></td></tr>
+            )}
+            {visibleRecordings.map((recording, index) => (
+              <tr key={recording.id} ref={index === 0 ? measureRow : null} className="hover:bg-gray-50 dark:hover:bg-gray-700">
                 <td className="px-4 py-4 whitespace-nowrap">
                   <input
                     type="checkbox"
@@ -156,9 +241,18 @@ export function RecordingsTable({
                 </td>
               </tr>
             ))}
+            {last < recordings.length && (
+              <tr aria-hidden="true" style={{ height: `${(recordings.length - last) * rowHeight}px` }}><td colSpan="7"></td></tr>
+            )}
           </tbody>
         </table>
       </div>
+      <div className="p-4 border-t border-gray-200 dark:border-gray-700 text-sm text-gray-600 dark:text-gray-400 flex justify-between items-center">
+        <span id="recordings-loaded">
+          Showing {recordings.length} of {Math.max(totalItems, recordings.length)} recordings
+        </span>
+        {isLoadingMore && <span>Loading more...</span>}
+      </div>
     </div>
   );
 }
@@ -2,6 +2,7 @@
  * API functions for RecordingsView
  */
 
+import { useState, useEffect, useRef } from 'preact/hooks';
 import { showStatusMessage } from '../ToastContainer.jsx';
 import { formatUtils } from './formatUtils.js';
 import { fetchJSON, enhancedFetch } from '../../../fetch-utils.js';
@@ -33,55 +34,140 @@ export const recordingsAPI = {
     },
 
     /**
-     * Hook to fetch recordings with filters
+     * Hook to load recordings page by page as the list is scrolled
+     *
+     * Recordings sorted by start time are continued with the keyset cursor
+     * of the previous page, so each page is one index seek on the server
+     * however far down the list it is; only the first page is counted.
+     * Other sort fields fall back to page numbers. The page after the last
+     * one loaded is fetched ahead, so scrolling on rarely waits.
+     *
      * @param {Object} filters Filter settings
-     * @param {Object} pagination Pagination settings
      * @param {string} sortField Sort field
      * @param {string} sortDirection Sort direction
-     * @returns {Object} Query result
+     * @param {number} pageSize Recordings per request
+     * @returns {Object} Loaded recordings, total, loading state, loadMore, reload and removeRecordings
      */
-    useRecordings: (filters, pagination, sortField, sortDirection) => {
-      // Build query parameters
-      const params = new URLSearchParams();
-      params.append('page', pagination.currentPage);
-      params.append('limit', pagination.pageSize);
-      params.append('sort', sortField);
-      params.append('order', sortDirection);
-
-      // Add date range filters
-      if (filters.dateRange === 'custom') {
-        params.append('start', `${filters.startDate}T${filters.startTime}:00`);
-        params.append('end', `${filters.endDate}T${filters.endTime}:00`);
-      } else {
-        // Convert predefined range to actual dates
-        const { start, end } = recordingsAPI.getDateRangeFromPreset(filters.dateRange);
-        params.append('start', start);
-        params.append('end', end);
-      }
+    useRecordingsFeed: (filters, sortField, sortDirection, pageSize) => {
+      const [state, setState] = useState({
+        recordings: [],
+        total: 0,
+        hasMore: false,
+        isLoading: true,
+        isLoadingMore: false,
+        error: null
+      });
+      const [reloadCount, setReloadCount] = useState(0);
+
+      // Where the next page starts, the page fetched ahead, and the
+      // controller of the current list; a new list aborts the old one
+      const nextRef = useRef(null);
+      const prefetchRef = useRef(null);
+      const loadingRef = useRef(false);
+      const controllerRef = useRef(null);
+
+      const fetchNext = (controller) => {
+        const next = nextRef.current;
+        return recordingsAPI.fetchRecordingsPage(filters, sortField, sortDirection, pageSize, {
+          cursor: next.cursor,
+          page: next.page,
+          signal: controller.signal
+        });
+      };
 
-      // Add stream filter
-      if (filters.streamId !== 'all') {
-        params.append('stream', filters.streamId);
-      }
+      // Remember where the page after this one starts, and fetch it ahead
+      const advance = (data, controller) => {
+        const recordings = data.recordings || [];
+        const nextCursor = data.pagination ? data.pagination.next_cursor : null;
+        const hasMore = data.pagination && data.pagination.has_more !== undefined
+          ? data.pagination.has_more
+          : recordings.length === pageSize;
+        nextRef.current = hasMore ? { cursor: nextCursor, page: nextRef.current.page + 1 } : null;
+        prefetchRef.current = null;
+        if (hasMore) {
+          const prefetch = fetchNext(controller);
+          // Failures are reported once the page is actually needed
+          prefetch.catch(() => {});
+          prefetchRef.current = prefetch;
+        }
+        return hasMore;
+      };
 
-      // Add recording type filter
-      if (filters.recordingType === 'detection') {
-        params.append('detection', '1');
-      }
+      useEffect(() => {
+        const controller = new AbortController();
+        controllerRef.current = controller;
+        nextRef.current = { cursor: null, page: 1 };
+        prefetchRef.current = null;
+        loadingRef.current = true;
+        setState(prev => ({ ...prev, recordings: [], isLoading: true, isLoadingMore: false, error: null }));
+
+        recordingsAPI.fetchRecordingsPage(filters, sortField, sortDirection, pageSize, {
+          withCount: true,
+          signal: controller.signal
+        }).then(data => {
+          if (controller.signal.aborted) return;
+          loadingRef.current = false;
+          const hasMore = advance(data, controller);
+          setState({
+            recordings: data.recordings || [],
+            total: (data.pagination && data.pagination.total) || 0,
+            hasMore,
+            isLoading: false,
+            isLoadingMore: false,
+            error: null
+          });
+        }).catch(error => {
+          if (controller.signal.aborted) return;
+          loadingRef.current = false;
+          setState(prev => ({ ...prev, hasMore: false, isLoading: false, error }));
+        });
+
+        return () => controller.abort();
+      }, [JSON.stringify(filters), sortField, sortDirection, pageSize, reloadCount]);
+
+      const loadMore = () => {
+        const controller = controllerRef.current;
+        if (loadingRef.current || !nextRef.current || !controller) return;
+
+        loadingRef.current = true;
+        setState(prev => ({ ...prev, isLoadingMore: true }));
+        const pending = prefetchRef.current || fetchNext(controller);
+        pending.then(data => {
+          if (controller.signal.aborted) return;
+          loadingRef.current = false;
+          const hasMore = advance(data, controller);
+          setState(prev => ({
+            ...prev,
+            recordings: prev.recordings.concat(data.recordings || []),
+            hasMore,
+            isLoadingMore: false
+          }));
+        }).catch(error => {
+          if (controller.signal.aborted) return;
+          loadingRef.current = false;
+          prefetchRef.current = null;
+          setState(prev => ({ ...prev, isLoadingMore: false, error }));
+        });
+      };
 
-      // Create query key that includes all filter parameters
-      const queryKey = ['recordings', filters, pagination, sortField, sortDirection];
+      const removeRecordings = (ids) => {
+        const removed = new Set(ids);
+        setState(prev => {
+          const recordings = prev.recordings.filter(recording => !removed.has(recording.id));
+          return {
+            ...prev,
+            recordings,
+            total: Math.max(0, prev.total - (prev.recordings.length - recordings.length))
+          };
+        });
+      };
 
-      return useQuery(
-        queryKey,
-        `/api/recordings?${params.toString()}`,
-        {
-          timeout: 30000, // 30 second timeout for potentially large data
-          retries: 2,     // Retry twice
-          retryDelay: 1000 // 1 second between retries
-        },
-        // No special handling needed - we rely on the backend API for detection information
-      );
+      return {
+        ...state,
+        loadMore,
+        reload: () => setReloadCount(count => count + 1),
+        removeRecordings
+      };
     },
 
     // useRecordingDetections hook removed - we rely on the backend API for detection information
@@ -222,6 +308,71 @@ export const recordingsAPI = {
     return { start, end };
   },
 
+  /**
+   * Build the query parameters of a recordings request
+   * @param {Object} filters Filter settings
+   * @param {string} sortField Sort field
+   * @param {string} sortDirection Sort direction
+   * @returns {URLSearchParams} Query parameters
+   */
+  buildRecordingsParams: (filters, sortField, sortDirection) => {
+    const params = new URLSearchParams();
+    params.append('sort', sortField);
+    params.append('order', sortDirection);
+
+    // Add date range filters
+    if (filters.dateRange === 'custom') {
+      params.append('start', `${filters.startDate}T${filters.startTime}:00`);
+      params.append('end', `${filters.endDate}T${filters.endTime}:00`);
+    } else {
+      // Convert predefined range to actual dates
+      const { start, end } = recordingsAPI.getDateRangeFromPreset(filters.dateRange);
+      params.append('start', start);
+      params.append('end', end);
+    }
+
+    // Add stream filter
+    if (filters.streamId !== 'all') {
+      params.append('stream', filters.streamId);
+    }
+
+    // Add recording type filter
+    if (filters.recordingType === 'detection') {
+      params.append('detection', '1');
+    }
+
+    return params;
+  },
+
+  /**
+   * Fetch one page of recordings
+   * @param {Object} filters Filter settings
+   * @param {string} sortField Sort field
+   * @param {string} sortDirection Sort direction
+   * @param {number} pageSize Recordings per page
+   * @param {Object} options cursor or page to continue at, withCount to count all recordings, signal to abort
+   * @returns {Promise<Object>} Recordings data and pagination info
+   */
+  fetchRecordingsPage: (filters, sortField, sortDirection, pageSize, { cursor = null, page = 1, withCount = false, signal } = {}) => {
+    const params = recordingsAPI.buildRecordingsParams(filters, sortField, sortDirection);
+    params.append('limit', pageSize);
+    if (cursor) {
+      params.append('cursor', cursor);
+    } else {
+      params.append('page', page);
+    }
+    if (!withCount) {
+      params.append('count', '0');
+    }
+
+    return fetchJSON(`/api/recordings?${params.toString()}`, {
+      timeout: 30000, // 30 second timeout for potentially large data
+      retries: 2,     // Retry twice
+      retryDelay: 1000, // 1 second between retries
+      signal
+    });
+  },
+
   /**
    * Load recordings
    * @param {Object} filters Filter settings
@@ -233,32 +384,9 @@ export const recordingsAPI = {
   loadRecordings: async (filters, pagination, sortField, sortDirection) => {
     try {
       // Build query parameters
-      const params = new URLSearchParams();
+      const params = recordingsAPI.buildRecordingsParams(filters, sortField, sortDirection);
       params.append('page', pagination.currentPage);
       params.append('limit', pagination.pageSize);
-      params.append('sort', sortField);
-      params.append('order', sortDirection);
-
-      // Add date range filters
-      if (filters.dateRange === 'custom') {
-        params.append('start', `${filters.startDate}T${filters.startTime}:00`);
-        params.append('end', `${filters.endDate}T${filters.endTime}:00`);
-      } else {
-        // Convert predefined range to actual dates
-        const { start, end } = recordingsAPI.getDateRangeFromPreset(filters.dateRange);
-        params.append('start', start);
-        params.append('end', end);
-      }
-
-      // Add stream filter
-      if (filters.streamId !== 'all') {
-        params.append('stream', filters.streamId);
-      }
-
-      // Add recording type filter
-      if (filters.recordingType === 'detection') {
-        params.append('detection', '1');
-      }
 
       // Log the API request
       console.log('API Request:', `/api/recordings?${params.toString()}`);
@@ -30,8 +30,7 @@ export const urlUtils = {
         streamId: 'all',
         recordingType: 'all'
       },
-      page: 1,
-      limit: 20,
+      limit: 50,
       sort: 'start_time',
       order: 'desc'
     };
@@ -66,10 +65,7 @@ export const urlUtils = {
       result.filters.recordingType = 'detection';
     }
     
-    // Pagination
-    if (urlParams.has('page')) {
-      result.page = parseInt(urlParams.get('page'), 10);
-    }
+    // Page size; links from before the list was scrolled may still name a page
     if (urlParams.has('limit')) {
       result.limit = parseInt(urlParams.get('limit'), 10);
     }
@@ -184,13 +180,7 @@ export const urlUtils = {
     // Update filters state
     setFilters(newFilters);
     
-    // Pagination
-    if (urlParams.has('page')) {
-      setPagination(prev => ({
-        ...prev,
-        currentPage: parseInt(urlParams.get('page'), 10)
-      }));
-    }
+    // Page size; the list itself is scrolled, not paged
     if (urlParams.has('limit')) {
       setPagination(prev => ({
         ...prev,
@@ -252,8 +242,8 @@ export const urlUtils = {
       params.delete('detection');
     }
     
-    // Update pagination
-    params.set('page', pagination.currentPage.toString());
+    // Update page size
+    params.delete('page');
     params.set('limit', pagination.pageSize.toString());
     
     // Update sorting
@@ -20,6 +20,8 @@ export function LogsPoller({ logLevel, logCount, onLogsReceived }) {
   const pollingIntervalRef = useRef(null);
   // Initialize with null, but will persist between renders
   const lastTimestampRef = useRef(null);
+  // Sequence number of the last log received, exact where timestamps are not
+  const lastSeqRef = useRef(null);
 
   // Try to load the last timestamp from localStorage on initial render
   useEffect(() => {
@@ -58,8 +60,10 @@ export function LogsPoller({ logLevel, logCount, onLogsReceived }) {
       count: logCount
     };
 
-    // Add last timestamp if available for pagination
-    if (lastTimestampRef.current) {
+    // Resume after the last log received, by sequence number when known
+    if (lastSeqRef.current) {
+      payload.last_seq = lastSeqRef.current;
+    } else if (lastTimestampRef.current) {
       payload.last_timestamp = lastTimestampRef.current;
     }
 
@@ -154,6 +158,11 @@ export function LogsPoller({ logLevel, logCount, onLogsReceived }) {
             console.log('Updated and saved last log timestamp:', payload.latest_timestamp);
           }
 
+          // Sequence numbers restart with the server, so they are not persisted
+          if (payload.latest_seq) {
+            lastSeqRef.current = payload.latest_seq;
+          }
+
           // Call the callback with the logs - parent will filter
           if (cleanedLogs.length > 0) {
             console.log(`Received ${cleanedLogs.length} logs via WebSocket`);